@@ -0,0 +1,171 @@
+/**
+ * @file bench.h
+ * @brief Microbenchmark harness for the core data structures
+ *
+ * A benchmark is a function that runs a given number of operations. The
+ * harness calibrates the count so one run lasts at least the minimum run
+ * time, repeats the run and reports the median: nanoseconds and cycles per
+ * operation and the throughput of all threads together. With more than
+ * one thread every thread runs the same count at once, started together
+ * from a barrier.
+ *
+ * Where the system has hardware performance counters, every thread also
+ * counts cycles, instructions and cache, branch and TLB misses over its
+ * run (common/perf_counters.h), reported per operation, so a regression
+ * shows whether it is compute- or memory-bound.
+ *
+ * Suites set their tables up, call bench_run() for every table size and
+ * thread count they cover and tear the tables down again. Results go to
+ * stdout as a table and, with --json, to a file for regression tracking.
+ */
+
+#ifndef SWITCH_SIM_BENCH_H
+#define SWITCH_SIM_BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <time.h>
+
+#include "common/logging.h"
+#include "common/perf_counters.h"
+
+#define BENCH_MAX_THREADS       64      /**< Most threads of one run */
+#define BENCH_MAX_RESULTS       512     /**< Results kept for the JSON report */
+#define BENCH_NAME_MAX          48
+#define BENCH_PARAMS_MAX        64
+
+/**
+ * @brief Work of one thread in one run
+ */
+typedef struct {
+    uint64_t iterations;        /**< Operations to run */
+    uint32_t thread_index;      /**< 0 .. thread_count - 1 */
+    uint32_t thread_count;
+    void *ctx;                  /**< Suite context given to bench_run() */
+    uint64_t sink;              /**< Fold results in here so they are not optimized out */
+} bench_thread_t;
+
+/**
+ * @brief Benchmark body: run t->iterations operations
+ */
+typedef void (*bench_fn_t)(bench_thread_t *t);
+
+/**
+ * @brief Harness settings, from the command line
+ */
+typedef struct {
+    uint32_t min_time_ms;       /**< Shortest calibrated run */
+    uint32_t repetitions;       /**< Runs per result; the median is reported */
+    uint32_t max_threads;       /**< Thread counts run are 1, 2, 4 ... up to this */
+    bool quick;                 /**< Smallest table sizes only */
+    bool perf;                  /**< Count hardware events where available */
+    const char *filter;         /**< Run only benchmarks whose name contains this */
+} bench_config_t;
+
+/**
+ * @brief One reported result
+ */
+typedef struct {
+    char name[BENCH_NAME_MAX];
+    char params[BENCH_PARAMS_MAX];
+    uint32_t threads;
+    uint64_t iterations;        /**< Operations per thread per run */
+    double ns_per_op;           /**< Median wall time per operation of one thread */
+    double cycles_per_op;       /**< Median cycles per operation of one thread */
+    double mops;                /**< Median throughput of all threads, millions of operations per second */
+    bool has_events;            /**< Hardware events were counted */
+    double events[PERF_COUNTER_COUNT];  /**< Median events per operation, by perf_counter_t */
+} bench_result_t;
+
+/**
+ * @brief Suite entry point
+ */
+typedef void (*bench_suite_fn_t)(const bench_config_t *config);
+
+/**
+ * @brief Read the cycle counter
+ *
+ * The TSC where there is one, monotonic nanoseconds elsewhere.
+ */
+static inline uint64_t bench_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Monotonic time in nanoseconds
+ */
+static inline uint64_t bench_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Start logging with every category at level
+ *
+ * log_init() gives each category the global level of the time and the
+ * higher of the two wins, so log_set_level() alone leaves them verbose.
+ */
+static inline void bench_init_logging(log_level_t level) {
+    log_init(NULL);
+    log_set_level(level);
+    for (uint32_t c = 0; c < LOG_CATEGORY_COUNT; c++) {
+        log_set_category_level((log_category_t)c, level);
+    }
+}
+
+/**
+ * @brief Small fast generator for keys, xorshift64*
+ */
+static inline uint64_t bench_rand(uint64_t *state) {
+    uint64_t x = *state;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief Check the benchmark name against the --filter option
+ *
+ * True if either contains the other, so a suite checking its name prefix
+ * runs for a filter on any one of its benchmarks.
+ */
+bool bench_selected(const bench_config_t *config, const char *name);
+
+/**
+ * @brief Calibrate, run and report one benchmark
+ *
+ * Does nothing if the name does not pass the filter.
+ *
+ * @param config Harness settings
+ * @param name Benchmark name, such as "mac_table_lookup"
+ * @param params Parameters of this run, such as "entries=65536"
+ * @param fn Benchmark body
+ * @param ctx Suite context handed to every thread
+ * @param threads Threads to run at once
+ */
+void bench_run(const bench_config_t *config, const char *name, const char *params,
+               bench_fn_t fn, void *ctx, uint32_t threads);
+
+/* Suites */
+void bench_suite_mac_table(const bench_config_t *config);
+void bench_suite_vlan(const bench_config_t *config);
+void bench_suite_routing(const bench_config_t *config);
+void bench_suite_arp(const bench_config_t *config);
+void bench_suite_packet(const bench_config_t *config);
+
+#endif /* SWITCH_SIM_BENCH_H */
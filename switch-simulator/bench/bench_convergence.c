@@ -0,0 +1,1335 @@
+/**
+ * @file bench_convergence.c
+ * @brief Routing convergence harness: time from a topology change to a consistent FIB
+ *
+ * Builds an emulated area of routers around this switch, a grid or a ring
+ * with link costs drawn from --seed, and drives it through a fixed cycle
+ * of events:
+ *
+ *   link-down-local    a link of the switch itself fails
+ *   link-up-local      and comes back
+ *   link-down-remote   a link between two other routers fails
+ *   link-up-remote     and comes back
+ *   withdraw           a router stops advertising its prefixes
+ *   advertise          and advertises them again
+ *
+ * The topology engine (hal/topology.h) bridges L2 only and leaves routing
+ * to the process's own switch, so the other routers exist here only as
+ * what they tell that switch. Under OSPF they are the router-LSAs the
+ * harness feeds to the area's SPF engine (l3/ospf_spf.h), which computes
+ * the routes as the switch's OSPF task does. Under RIP every router runs
+ * a distance vector with split horizon and poisoned reverse, exchanging
+ * triggered updates in rounds and one periodic update once they settle,
+ * and the switch applies what it receives after each round. Either way the switch's routes are installed through
+ * routing_add_route() in one batch per SPF run or round, as a protocol
+ * installs them.
+ *
+ * For every event the harness records:
+ *
+ *   convergence  wall time from the event until the FIB is consistent:
+ *                every route installed and the hardware queue flushed.
+ *                After each event every prefix is looked up and checked
+ *                against the protocol's own result; a mismatch counts as
+ *                inconsistent and fails the run
+ *   compute      CPU time of ospf_spf_run(), with the full and partial
+ *                runs the engine counted, or of the distance-vector
+ *                rounds, with their number
+ *   install      routes added per second of time spent in the routing
+ *                table
+ *   loss         lookups of traffic threads that send to every advertised
+ *                prefix during the event, lost when no route matches or
+ *                the route points into a failed link
+ *
+ * A failed link of the switch is detected at once, as BFD or loss of
+ * signal would, and its next hop marked down, so with --lfa the loop-free
+ * alternates the SPF engine precomputes carry the traffic until the new
+ * routes are in. --spf-delay-ms and --rip-delay-ms add the protocol's own
+ * hold-down, SPF throttling or triggered update delay, to the convergence
+ * time and so to the loss; both are 0 by default, so the numbers measure
+ * the code rather than the timers.
+ *
+ * With --max-convergence-ms=X the harness exits with status 1 when the
+ * p99 convergence of any event type is above X, so a build can be gated
+ * on it; --label names the build in the CSV and JSON output.
+ *
+ * Usage: switch-convergence-bench [--protocol=ospf|rip|all] [--topology=grid|ring]
+ *            [--routers=N] [--prefixes=N] [--cycles=N] [--seed=N] [--lfa]
+ *            [--spf-delay-ms=N] [--rip-delay-ms=N] [--traffic=N] [--label=NAME]
+ *            [--csv=FILE] [--json=FILE] [--max-convergence-ms=X]
+ */
+
+#include "bench.h"
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/logging.h"
+#include "common/types.h"
+#include "l3/ip.h"
+#include "l3/ospf_spf.h"
+#include "l3/routing_table.h"
+
+#define CONV_MAX_ROUTERS        1024
+#define CONV_MAX_DEGREE         4       /* Grid and ring routers have at most four neighbors */
+#define CONV_MAX_PREFIXES       65536   /* /24 numbering of conv_prefix_network() */
+#define CONV_PREFIX_LEN         24
+#define CONV_COST_MIN           10
+#define CONV_COST_SPREAD        30      /* Link costs are CONV_COST_MIN .. + CONV_COST_SPREAD - 1 */
+#define CONV_RIP_INFINITY       16
+#define CONV_RIP_MAX_ROUNDS     256
+#define CONV_TRAFFIC_BATCH      64      /* Lookups between two updates of the shared counters */
+#define CONV_MAX_TRAFFIC        16
+#define CONV_NONE               0xFFFFu
+
+typedef enum {
+    CONV_PROTO_OSPF = 0,
+    CONV_PROTO_RIP,
+    CONV_PROTO_COUNT
+} conv_protocol_t;
+
+static const char *const g_protocol_names[CONV_PROTO_COUNT] = { "ospf", "rip" };
+
+typedef enum {
+    CONV_EVENT_BRINGUP = 0,
+    CONV_EVENT_LINK_DOWN_LOCAL,
+    CONV_EVENT_LINK_UP_LOCAL,
+    CONV_EVENT_LINK_DOWN_REMOTE,
+    CONV_EVENT_LINK_UP_REMOTE,
+    CONV_EVENT_WITHDRAW,
+    CONV_EVENT_ADVERTISE,
+    CONV_EVENT_COUNT
+} conv_event_t;
+
+static const char *const g_event_names[CONV_EVENT_COUNT] = {
+    "bringup", "link-down-local", "link-up-local", "link-down-remote", "link-up-remote",
+    "withdraw", "advertise",
+};
+
+typedef struct {
+    bool protocols[CONV_PROTO_COUNT];
+    bool ring;
+    uint32_t routers;
+    uint32_t prefixes;          /* Per router */
+    uint32_t cycles;            /* Passes through the event cycle */
+    uint64_t seed;
+    bool lfa;
+    uint32_t spf_delay_ms;
+    uint32_t rip_delay_ms;
+    uint32_t traffic_threads;
+    const char *label;
+    const char *csv;
+    const char *json;
+    double max_convergence_ms;  /* 0: no gate */
+} conv_config_t;
+
+/* ----------------------------------------------------------------------------
+ * Topology
+ * ------------------------------------------------------------------------- */
+
+typedef struct {
+    uint16_t a;                 /* Routers at the two ends */
+    uint16_t b;
+    uint32_t cost;
+    volatile bool up;           /* Read by the traffic threads */
+} conv_link_t;
+
+typedef struct {
+    uint16_t count;
+    uint16_t neighbor[CONV_MAX_DEGREE];
+    uint16_t link[CONV_MAX_DEGREE];
+} conv_adjacency_t;
+
+typedef struct {
+    uint32_t routers;
+    uint32_t links;
+    uint32_t root;              /* The switch under test */
+    uint32_t prefixes;          /* Per router; the switch has none of its own */
+    conv_link_t *link;
+    conv_adjacency_t *adj;
+    volatile bool *withdrawn;   /* By router, read by the traffic threads */
+} conv_topology_t;
+
+static conv_topology_t g_topo;
+
+static inline uint32_t conv_router_id(uint32_t router) {
+    return 0x0AFE0000U + router + 1;    /* 10.254.0.1 upward */
+}
+
+/* Network of /24 number i, host order, as the scale harness numbers them */
+static inline uint32_t conv_prefix_network(uint32_t i) {
+    return ((10U + (i >> 16)) << 24) | ((i & 0xffffU) << 8);
+}
+
+static inline uint32_t conv_prefix_owner(uint32_t i) {
+    return i / g_topo.prefixes;
+}
+
+/* Address of router on link, a /30 per link in 172.16.0.0/16 */
+static inline uint32_t conv_link_address(uint32_t link, uint32_t router) {
+    return 0xAC100000U | (link << 2) | (g_topo.link[link].a == router ? 1U : 2U);
+}
+
+/* Slot of neighbor among the switch's links, the interface index less one */
+static uint32_t conv_root_slot(uint32_t neighbor) {
+    const conv_adjacency_t *adj = &g_topo.adj[g_topo.root];
+
+    for (uint32_t s = 0; s < adj->count; s++) {
+        if (adj->neighbor[s] == neighbor) {
+            return s;
+        }
+    }
+    return CONV_NONE;
+}
+
+static bool conv_add_link(uint32_t a, uint32_t b, uint64_t *seed) {
+    conv_link_t *link = &g_topo.link[g_topo.links];
+
+    if (g_topo.adj[a].count >= CONV_MAX_DEGREE || g_topo.adj[b].count >= CONV_MAX_DEGREE) {
+        return false;
+    }
+    link->a = (uint16_t)a;
+    link->b = (uint16_t)b;
+    link->cost = CONV_COST_MIN + (uint32_t)(bench_rand(seed) % CONV_COST_SPREAD);
+    link->up = true;
+    g_topo.adj[a].neighbor[g_topo.adj[a].count] = (uint16_t)b;
+    g_topo.adj[a].link[g_topo.adj[a].count++] = (uint16_t)g_topo.links;
+    g_topo.adj[b].neighbor[g_topo.adj[b].count] = (uint16_t)a;
+    g_topo.adj[b].link[g_topo.adj[b].count++] = (uint16_t)g_topo.links;
+    g_topo.links++;
+    return true;
+}
+
+/**
+ * @brief Lay the routers out as a near-square grid or a ring
+ *
+ * The switch sits in the middle of the grid, where it has the most
+ * neighbors and the most equal-cost choices.
+ */
+static status_t conv_build_topology(const conv_config_t *config) {
+    uint64_t seed = config->seed;
+    uint32_t width = 1;
+
+    memset(&g_topo, 0, sizeof(g_topo));
+    g_topo.routers = config->routers;
+    g_topo.prefixes = config->prefixes;
+    g_topo.link = calloc((size_t)config->routers * 2, sizeof(conv_link_t));
+    g_topo.adj = calloc(config->routers, sizeof(conv_adjacency_t));
+    g_topo.withdrawn = calloc(config->routers, sizeof(bool));
+    if (!g_topo.link || !g_topo.adj || !g_topo.withdrawn) {
+        return STATUS_NO_MEMORY;
+    }
+
+    if (config->ring) {
+        for (uint32_t r = 0; r < config->routers; r++) {
+            conv_add_link(r, (r + 1) % config->routers, &seed);
+        }
+        g_topo.root = 0;
+        return STATUS_SUCCESS;
+    }
+
+    while ((width + 1) * (width + 1) <= config->routers) {
+        width++;
+    }
+    for (uint32_t r = 0; r < config->routers; r++) {
+        if ((r % width) + 1 < width && r + 1 < config->routers) {
+            conv_add_link(r, r + 1, &seed);
+        }
+        if (r + width < config->routers) {
+            conv_add_link(r, r + width, &seed);
+        }
+    }
+    g_topo.root = (config->routers / width / 2) * width + width / 2;
+    return STATUS_SUCCESS;
+}
+
+static void conv_free_topology(void) {
+    free(g_topo.link);
+    free(g_topo.adj);
+    free((void *)g_topo.withdrawn);
+    memset(&g_topo, 0, sizeof(g_topo));
+}
+
+/* ----------------------------------------------------------------------------
+ * Traffic
+ * ------------------------------------------------------------------------- */
+
+typedef struct {
+    pthread_t thread;
+    uint32_t index;
+    volatile bool stop;
+    uint64_t sent;              /* Published every CONV_TRAFFIC_BATCH lookups */
+    uint64_t lost;
+} conv_traffic_t;
+
+static conv_traffic_t g_traffic[CONV_MAX_TRAFFIC];
+
+/**
+ * @brief Send to every advertised prefix in turn and count what would be lost
+ */
+static void *conv_traffic_thread(void *arg) {
+    conv_traffic_t *t = arg;
+    uint32_t total = g_topo.routers * g_topo.prefixes;
+    uint32_t next = t->index * 7919;
+    uint64_t sent = 0;
+    uint64_t lost = 0;
+
+    while (!__atomic_load_n(&t->stop, __ATOMIC_RELAXED)) {
+        for (uint32_t k = 0; k < CONV_TRAFFIC_BATCH; k++) {
+            uint32_t p = next++ % total;
+            uint32_t owner = conv_prefix_owner(p);
+            ip_addr_t dst = { .type = IP_TYPE_V4 };
+            ip_addr_t next_hop;
+            uint16_t interface_index;
+
+            if (owner == g_topo.root || __atomic_load_n(&g_topo.withdrawn[owner], __ATOMIC_RELAXED)) {
+                continue;
+            }
+            dst.addr.v4 = htonl(conv_prefix_network(p) | 1);
+            sent++;
+            if (routing_lookup_nexthop(&dst, IP_TYPE_V4, p, &next_hop, &interface_index) != STATUS_SUCCESS ||
+                interface_index == 0 || interface_index > g_topo.adj[g_topo.root].count ||
+                !__atomic_load_n(&g_topo.link[g_topo.adj[g_topo.root].link[interface_index - 1]].up,
+                                 __ATOMIC_RELAXED)) {
+                lost++;
+            }
+        }
+        __atomic_store_n(&t->sent, sent, __ATOMIC_RELAXED);
+        __atomic_store_n(&t->lost, lost, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+static void conv_traffic_counts(uint32_t threads, uint64_t *sent, uint64_t *lost) {
+    *sent = 0;
+    *lost = 0;
+    for (uint32_t i = 0; i < threads; i++) {
+        *sent += __atomic_load_n(&g_traffic[i].sent, __ATOMIC_RELAXED);
+        *lost += __atomic_load_n(&g_traffic[i].lost, __ATOMIC_RELAXED);
+    }
+}
+
+static uint32_t conv_traffic_start(uint32_t threads) {
+    uint32_t started = 0;
+
+    for (; started < threads; started++) {
+        memset(&g_traffic[started], 0, sizeof(g_traffic[started]));
+        g_traffic[started].index = started;
+        if (pthread_create(&g_traffic[started].thread, NULL, conv_traffic_thread, &g_traffic[started]) != 0) {
+            break;
+        }
+    }
+    return started;
+}
+
+static void conv_traffic_stop(uint32_t threads) {
+    for (uint32_t i = 0; i < threads; i++) {
+        __atomic_store_n(&g_traffic[i].stop, true, __ATOMIC_RELAXED);
+    }
+    for (uint32_t i = 0; i < threads; i++) {
+        pthread_join(g_traffic[i].thread, NULL);
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Measurements
+ * ------------------------------------------------------------------------- */
+
+/**
+ * @brief What one event cost, and what all events of a type cost together
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t capacity;
+    double *convergence_us;     /* One per event, for the percentiles */
+    double compute_us;          /* CPU time of SPF runs or distance-vector rounds */
+    double compute_max_us;
+    uint64_t full_runs;
+    uint64_t partial_runs;
+    uint32_t rounds_max;
+    uint64_t routes_changed;
+    uint64_t installs;          /* routing_add_route() calls */
+    uint64_t install_ns;        /* Time spent in the routing table */
+    uint64_t sent;
+    uint64_t lost;
+    uint32_t inconsistent;      /* Prefixes whose FIB entry disagreed with the protocol */
+} conv_metrics_t;
+
+typedef struct {
+    conv_protocol_t protocol;
+    conv_metrics_t events[CONV_EVENT_COUNT];
+} conv_report_t;
+
+/* Cost of the event being handled */
+typedef struct {
+    uint64_t start_ns;
+    uint64_t sent;
+    uint64_t lost;
+    double compute_us;
+    uint64_t full_runs;
+    uint64_t partial_runs;
+    uint32_t rounds;
+    uint64_t routes_changed;
+    uint64_t installs;
+    uint64_t install_ns;
+} conv_sample_t;
+
+static inline uint64_t conv_cpu_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void conv_sleep_ms(uint32_t ms) {
+    if (ms > 0) {
+        usleep(ms * 1000U);
+    }
+}
+
+static void conv_sample_begin(const conv_config_t *config, conv_sample_t *sample) {
+    memset(sample, 0, sizeof(*sample));
+    conv_traffic_counts(config->traffic_threads, &sample->sent, &sample->lost);
+    sample->start_ns = bench_now_ns();
+}
+
+static void conv_sample_end(const conv_config_t *config, const conv_sample_t *sample, uint32_t inconsistent,
+                            conv_metrics_t *metrics) {
+    uint64_t elapsed = bench_now_ns() - sample->start_ns;
+    uint64_t sent;
+    uint64_t lost;
+
+    conv_traffic_counts(config->traffic_threads, &sent, &lost);
+    if (metrics->count == metrics->capacity) {
+        uint32_t capacity = metrics->capacity ? metrics->capacity * 2 : 16;
+        double *grown = realloc(metrics->convergence_us, sizeof(double) * capacity);
+        if (!grown) {
+            return;
+        }
+        metrics->convergence_us = grown;
+        metrics->capacity = capacity;
+    }
+    metrics->convergence_us[metrics->count++] = (double)elapsed / 1000.0;
+    metrics->compute_us += sample->compute_us;
+    if (sample->compute_us > metrics->compute_max_us) {
+        metrics->compute_max_us = sample->compute_us;
+    }
+    metrics->full_runs += sample->full_runs;
+    metrics->partial_runs += sample->partial_runs;
+    if (sample->rounds > metrics->rounds_max) {
+        metrics->rounds_max = sample->rounds;
+    }
+    metrics->routes_changed += sample->routes_changed;
+    metrics->installs += sample->installs;
+    metrics->install_ns += sample->install_ns;
+    metrics->sent += sent - sample->sent;
+    metrics->lost += lost - sample->lost;
+    metrics->inconsistent += inconsistent;
+}
+
+/**
+ * @brief The checks of one protocol
+ */
+typedef struct {
+    /* Brings the area up and installs the first routes */
+    status_t (*bringup)(const conv_config_t *config, conv_sample_t *sample);
+    /* Tells the area a link changed state; local links are marked in the FIB by the caller */
+    void (*link_changed)(uint32_t link);
+    /* Tells the area a router withdrew or advertised its prefixes */
+    void (*prefixes_changed)(uint32_t router);
+    /* Computes the new routes and installs them into the FIB */
+    void (*converge)(const conv_config_t *config, conv_sample_t *sample);
+    /* Prefixes whose FIB entry disagrees with the protocol */
+    uint32_t (*verify)(void);
+    void (*teardown)(void);
+} conv_ops_t;
+
+/* ----------------------------------------------------------------------------
+ * FIB
+ * ------------------------------------------------------------------------- */
+
+static void conv_prefix_address(uint32_t p, ip_addr_t *prefix) {
+    memset(prefix, 0, sizeof(*prefix));
+    prefix->type = IP_TYPE_V4;
+    prefix->addr.v4 = htonl(conv_prefix_network(p));
+}
+
+/* The switch's next hop through neighbor, false if it is not a neighbor */
+static bool conv_root_nexthop(uint32_t neighbor, ip_addr_t *next_hop, uint16_t *interface_index) {
+    uint32_t slot = conv_root_slot(neighbor);
+
+    if (slot == CONV_NONE) {
+        return false;
+    }
+    memset(next_hop, 0, sizeof(*next_hop));
+    next_hop->type = IP_TYPE_V4;
+    next_hop->addr.v4 = htonl(conv_link_address(g_topo.adj[g_topo.root].link[slot], neighbor));
+    *interface_index = (uint16_t)(slot + 1);
+    return true;
+}
+
+/**
+ * @brief Mark the next hop over a link of the switch down or up, as a port event would
+ */
+static void conv_root_link_state(uint32_t link, bool up) {
+    const conv_link_t *l = &g_topo.link[link];
+    uint32_t neighbor = l->a == g_topo.root ? l->b : l->a;
+    ip_addr_t next_hop;
+    uint16_t interface_index;
+
+    if (conv_root_nexthop(neighbor, &next_hop, &interface_index)) {
+        (void)routing_set_nexthop_state(&next_hop, IP_TYPE_V4, interface_index, up);
+    }
+}
+
+/**
+ * @brief Check one prefix of the FIB against the next hops the protocol chose
+ */
+static bool conv_fib_matches(uint32_t p, const uint16_t *neighbors, uint32_t count) {
+    ip_addr_t dst = { .type = IP_TYPE_V4 };
+    ip_addr_t next_hop;
+    uint16_t interface_index;
+    status_t status;
+
+    dst.addr.v4 = htonl(conv_prefix_network(p) | 1);
+    status = routing_lookup_nexthop(&dst, IP_TYPE_V4, p, &next_hop, &interface_index);
+    if (count == 0) {
+        return status != STATUS_SUCCESS;
+    }
+    if (status != STATUS_SUCCESS) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        ip_addr_t expected;
+        uint16_t expected_index;
+
+        if (conv_root_nexthop(neighbors[i], &expected, &expected_index) && expected_index == interface_index &&
+            expected.addr.v4 == next_hop.addr.v4) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* ----------------------------------------------------------------------------
+ * OSPF
+ * ------------------------------------------------------------------------- */
+
+static ospf_spf_t *g_spf;
+static ospf_spf_prefix_t *g_spf_stubs;      /* Stubs of the router-LSA being originated */
+static ospf_spf_route_t *g_spf_changes;
+static uint32_t g_spf_change_count;
+
+static uint32_t conv_router_by_id(uint32_t id) {
+    return id - conv_router_id(0);
+}
+
+/* Router-LSA of router as the engine takes it: its transit links, then its stubs */
+static void conv_ospf_originate(uint32_t router, bool prefixes) {
+    const conv_adjacency_t *adj = &g_topo.adj[router];
+    ospf_spf_link_t links[CONV_MAX_DEGREE];
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < adj->count; i++) {
+        const conv_link_t *l = &g_topo.link[adj->link[i]];
+        if (l->up) {
+            links[count].type = OSPF_SPF_VERTEX_ROUTER;
+            links[count].id = conv_router_id(adj->neighbor[i]);
+            links[count].metric = l->cost;
+            count++;
+        }
+    }
+    (void)ospf_spf_set_links(g_spf, OSPF_SPF_VERTEX_ROUTER, conv_router_id(router), links, count);
+
+    if (!prefixes || router == g_topo.root) {
+        return;
+    }
+    count = 0;
+    if (!g_topo.withdrawn[router]) {
+        for (uint32_t i = 0; i < g_topo.prefixes; i++) {
+            g_spf_stubs[count].addr = conv_prefix_network(router * g_topo.prefixes + i);
+            g_spf_stubs[count].prefix_len = CONV_PREFIX_LEN;
+            g_spf_stubs[count].metric = 1;
+            count++;
+        }
+    }
+    (void)ospf_spf_set_prefixes(g_spf, OSPF_SPF_VERTEX_ROUTER, conv_router_id(router),
+                                count ? g_spf_stubs : NULL, count);
+}
+
+static void conv_ospf_collect(const ospf_spf_route_t *route, void *ctx) {
+    (void)ctx;
+    if (g_spf_change_count < g_topo.routers * g_topo.prefixes) {
+        g_spf_changes[g_spf_change_count++] = *route;
+    }
+}
+
+/**
+ * @brief Replace the OSPF paths of the changed prefixes, in one batch
+ */
+static void conv_ospf_install(const conv_config_t *config, conv_sample_t *sample) {
+    uint64_t start = bench_now_ns();
+
+    (void)routing_table_begin_batch();
+    for (uint32_t c = 0; c < g_spf_change_count; c++) {
+        const ospf_spf_route_t *route = &g_spf_changes[c];
+        ip_addr_t prefix = { .type = IP_TYPE_V4 };
+        uint16_t metric = route->cost > 0xFFFFu ? 0xFFFFu : (uint16_t)route->cost;
+
+        prefix.addr.v4 = htonl(route->addr);
+        (void)routing_remove_route_source(&prefix, route->prefix_len, IP_TYPE_V4, ROUTE_TYPE_OSPF);
+        if (route->cost == OSPF_SPF_INFINITY) {
+            continue;
+        }
+        for (uint32_t n = 0; n < route->nexthop_count; n++) {
+            ip_addr_t next_hop;
+            uint16_t interface_index;
+
+            if (conv_root_nexthop(conv_router_by_id(route->nexthops[n]), &next_hop, &interface_index) &&
+                routing_add_route(&prefix, route->prefix_len, IP_TYPE_V4, &next_hop, interface_index, metric,
+                                  ROUTE_TYPE_OSPF) == STATUS_SUCCESS) {
+                sample->installs++;
+            }
+        }
+        if (config->lfa && route->backup) {
+            ip_addr_t backup;
+            uint16_t interface_index;
+
+            if (conv_root_nexthop(conv_router_by_id(route->backup), &backup, &interface_index)) {
+                (void)routing_set_backup_nexthop(&prefix, route->prefix_len, IP_TYPE_V4, ROUTE_TYPE_OSPF, &backup,
+                                                 interface_index);
+            }
+        }
+    }
+    (void)routing_table_commit_batch();
+    (void)routing_table_hw_sync_flush();
+
+    sample->install_ns += bench_now_ns() - start;
+    sample->routes_changed += g_spf_change_count;
+}
+
+static void conv_ospf_converge(const conv_config_t *config, conv_sample_t *sample) {
+    ospf_spf_stats_t before;
+    ospf_spf_stats_t after;
+    uint64_t cpu;
+
+    conv_sleep_ms(config->spf_delay_ms);
+
+    (void)ospf_spf_get_stats(g_spf, &before);
+    g_spf_change_count = 0;
+    cpu = conv_cpu_ns();
+    (void)ospf_spf_run(g_spf, conv_ospf_collect, NULL);
+    sample->compute_us += (double)(conv_cpu_ns() - cpu) / 1000.0;
+    (void)ospf_spf_get_stats(g_spf, &after);
+    sample->full_runs += after.full_runs - before.full_runs;
+    sample->partial_runs += after.partial_runs - before.partial_runs;
+
+    conv_ospf_install(config, sample);
+}
+
+static status_t conv_ospf_bringup(const conv_config_t *config, conv_sample_t *sample) {
+    g_spf = ospf_spf_create(conv_router_id(g_topo.root));
+    g_spf_stubs = calloc(g_topo.prefixes, sizeof(ospf_spf_prefix_t));
+    g_spf_changes = calloc((size_t)g_topo.routers * g_topo.prefixes, sizeof(ospf_spf_route_t));
+    if (!g_spf || !g_spf_stubs || !g_spf_changes) {
+        return STATUS_NO_MEMORY;
+    }
+    for (uint32_t r = 0; r < g_topo.routers; r++) {
+        conv_ospf_originate(r, true);
+    }
+    conv_ospf_converge(config, sample);
+    return STATUS_SUCCESS;
+}
+
+/* Both ends originate a new router-LSA */
+static void conv_ospf_link_changed(uint32_t link) {
+    conv_ospf_originate(g_topo.link[link].a, false);
+    conv_ospf_originate(g_topo.link[link].b, false);
+}
+
+static void conv_ospf_prefixes_changed(uint32_t router) {
+    conv_ospf_originate(router, true);
+}
+
+static uint32_t conv_ospf_verify(void) {
+    uint32_t inconsistent = 0;
+
+    for (uint32_t p = 0; p < g_topo.routers * g_topo.prefixes; p++) {
+        ospf_spf_route_t route;
+        uint16_t neighbors[OSPF_SPF_MAX_PATHS];
+        uint32_t count = 0;
+
+        if (conv_prefix_owner(p) == g_topo.root) {
+            continue;
+        }
+        if (ospf_spf_get_route(g_spf, conv_prefix_network(p), CONV_PREFIX_LEN, &route) == STATUS_SUCCESS &&
+            route.cost != OSPF_SPF_INFINITY) {
+            for (uint32_t n = 0; n < route.nexthop_count; n++) {
+                neighbors[count++] = (uint16_t)conv_router_by_id(route.nexthops[n]);
+            }
+        }
+        if (!conv_fib_matches(p, neighbors, count)) {
+            inconsistent++;
+        }
+    }
+    return inconsistent;
+}
+
+static void conv_ospf_teardown(void) {
+    ospf_spf_destroy(g_spf);
+    free(g_spf_stubs);
+    free(g_spf_changes);
+    g_spf = NULL;
+    g_spf_stubs = NULL;
+    g_spf_changes = NULL;
+}
+
+/* ----------------------------------------------------------------------------
+ * RIP
+ * ------------------------------------------------------------------------- */
+
+/*
+ * Distance vectors by destination router; the prefixes of a router all
+ * follow its entry. Entry d of router r is at r * routers + d.
+ */
+static uint8_t *g_rip_metric;
+static uint16_t *g_rip_via;
+static uint8_t *g_rip_changed;      /* To send in the next triggered update */
+static uint8_t *g_rip_sending;      /* Being sent in this round */
+static uint8_t *g_rip_installed;    /* Metric of the switch's routes in the FIB, by destination */
+static uint16_t *g_rip_installed_via;
+
+static inline size_t conv_rip_entry(uint32_t router, uint32_t dest) {
+    return (size_t)router * g_topo.routers + dest;
+}
+
+static void conv_rip_set(uint32_t router, uint32_t dest, uint8_t metric, uint16_t via) {
+    size_t e = conv_rip_entry(router, dest);
+
+    if (g_rip_metric[e] != metric || g_rip_via[e] != via) {
+        g_rip_metric[e] = metric;
+        g_rip_via[e] = via;
+        g_rip_changed[e] = 1;
+    }
+}
+
+/**
+ * @brief Apply one entry of a response from neighbor (RFC 2453 3.9.2)
+ */
+static void conv_rip_receive(uint32_t router, uint32_t neighbor, uint32_t dest, uint8_t advertised) {
+    size_t e = conv_rip_entry(router, dest);
+    uint8_t metric = advertised + 1 < CONV_RIP_INFINITY ? (uint8_t)(advertised + 1) : CONV_RIP_INFINITY;
+
+    if (g_rip_via[e] == neighbor) {
+        conv_rip_set(router, dest, metric, (uint16_t)neighbor);
+    } else if (metric < g_rip_metric[e]) {
+        conv_rip_set(router, dest, metric, (uint16_t)neighbor);
+    }
+}
+
+/**
+ * @brief One round: every router sends its changed entries to its neighbors
+ *
+ * @return Entries sent; 0 once the area is quiet
+ */
+static uint32_t conv_rip_round(void) {
+    uint32_t n = g_topo.routers;
+    uint32_t sent = 0;
+    uint8_t *swap = g_rip_sending;
+
+    g_rip_sending = g_rip_changed;
+    g_rip_changed = swap;
+    memset(g_rip_changed, 0, (size_t)n * n);
+
+    for (uint32_t r = 0; r < n; r++) {
+        const conv_adjacency_t *adj = &g_topo.adj[r];
+
+        for (uint32_t d = 0; d < n; d++) {
+            size_t e = conv_rip_entry(r, d);
+            if (!g_rip_sending[e]) {
+                continue;
+            }
+            sent++;
+            for (uint32_t i = 0; i < adj->count; i++) {
+                uint32_t neighbor = adj->neighbor[i];
+                if (!g_topo.link[adj->link[i]].up) {
+                    continue;
+                }
+                /* Poisoned reverse: a route learned from the neighbor goes back to it as unreachable */
+                conv_rip_receive(neighbor, r, d, g_rip_via[e] == neighbor ? CONV_RIP_INFINITY : g_rip_metric[e]);
+            }
+        }
+    }
+    return sent;
+}
+
+/**
+ * @brief Bring the switch's RIP routes in the FIB up to date, in one batch
+ */
+static void conv_rip_install(conv_sample_t *sample) {
+    uint64_t start = bench_now_ns();
+    uint32_t changed = 0;
+
+    (void)routing_table_begin_batch();
+    for (uint32_t d = 0; d < g_topo.routers; d++) {
+        size_t e = conv_rip_entry(g_topo.root, d);
+        uint8_t metric = g_rip_metric[e];
+        uint16_t via = metric < CONV_RIP_INFINITY ? g_rip_via[e] : CONV_NONE;
+        ip_addr_t next_hop;
+        uint16_t interface_index;
+        bool reachable;
+
+        if (d == g_topo.root || (metric == g_rip_installed[d] && via == g_rip_installed_via[d])) {
+            continue;
+        }
+        reachable = via != CONV_NONE && conv_root_nexthop(via, &next_hop, &interface_index);
+        for (uint32_t i = 0; i < g_topo.prefixes; i++) {
+            ip_addr_t prefix;
+
+            conv_prefix_address(d * g_topo.prefixes + i, &prefix);
+            (void)routing_remove_route_source(&prefix, CONV_PREFIX_LEN, IP_TYPE_V4, ROUTE_TYPE_RIP);
+            if (reachable && routing_add_route(&prefix, CONV_PREFIX_LEN, IP_TYPE_V4, &next_hop, interface_index,
+                                               metric, ROUTE_TYPE_RIP) == STATUS_SUCCESS) {
+                sample->installs++;
+            }
+            changed++;
+        }
+        g_rip_installed[d] = metric;
+        g_rip_installed_via[d] = via;
+    }
+    (void)routing_table_commit_batch();
+    (void)routing_table_hw_sync_flush();
+
+    sample->install_ns += bench_now_ns() - start;
+    sample->routes_changed += changed;
+}
+
+/**
+ * @brief Exchange updates until the area is quiet
+ *
+ * Triggered updates only carry routes that changed, so a router that lost
+ * its route hears of alternatives that did not change only in the next
+ * periodic update. It is taken as soon as the triggered updates settle,
+ * rather than up to 30 seconds later, then the triggered updates it sets
+ * off run out.
+ */
+static void conv_rip_converge(const conv_config_t *config, conv_sample_t *sample) {
+    bool periodic = false;
+
+    for (uint32_t round = 0; round < CONV_RIP_MAX_ROUNDS; round++) {
+        uint64_t cpu;
+        uint32_t sent;
+
+        conv_sleep_ms(config->rip_delay_ms);
+        cpu = conv_cpu_ns();
+        sent = conv_rip_round();
+        sample->compute_us += (double)(conv_cpu_ns() - cpu) / 1000.0;
+        if (sent == 0) {
+            if (periodic) {
+                break;
+            }
+            periodic = true;
+            memset(g_rip_changed, 1, (size_t)g_topo.routers * g_topo.routers);
+            continue;
+        }
+        sample->rounds++;
+        conv_rip_install(sample);
+    }
+}
+
+static status_t conv_rip_bringup(const conv_config_t *config, conv_sample_t *sample) {
+    size_t entries = (size_t)g_topo.routers * g_topo.routers;
+
+    g_rip_metric = malloc(entries);
+    g_rip_via = malloc(entries * sizeof(uint16_t));
+    g_rip_changed = calloc(entries, 1);
+    g_rip_sending = calloc(entries, 1);
+    g_rip_installed = malloc(g_topo.routers);
+    g_rip_installed_via = malloc(g_topo.routers * sizeof(uint16_t));
+    if (!g_rip_metric || !g_rip_via || !g_rip_changed || !g_rip_sending || !g_rip_installed ||
+        !g_rip_installed_via) {
+        return STATUS_NO_MEMORY;
+    }
+    memset(g_rip_metric, CONV_RIP_INFINITY, entries);
+    memset(g_rip_installed, CONV_RIP_INFINITY, g_topo.routers);
+    for (size_t e = 0; e < entries; e++) {
+        g_rip_via[e] = CONV_NONE;
+    }
+    for (uint32_t d = 0; d < g_topo.routers; d++) {
+        g_rip_installed_via[d] = CONV_NONE;
+        if (d != g_topo.root) {
+            conv_rip_set(d, d, 1, (uint16_t)d);
+        }
+    }
+    conv_rip_converge(config, sample);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Both ends see the link go down or come up
+ *
+ * Routes through a failed link become unreachable at once; over a link
+ * that came up both ends send their whole table.
+ */
+static void conv_rip_link_changed(uint32_t link) {
+    const conv_link_t *l = &g_topo.link[link];
+    uint32_t ends[2] = { l->a, l->b };
+
+    for (uint32_t i = 0; i < 2; i++) {
+        uint32_t router = ends[i];
+        uint32_t peer = ends[1 - i];
+
+        for (uint32_t d = 0; d < g_topo.routers; d++) {
+            size_t e = conv_rip_entry(router, d);
+            if (!l->up && g_rip_via[e] == peer) {
+                conv_rip_set(router, d, CONV_RIP_INFINITY, (uint16_t)peer);
+            } else if (l->up && g_rip_metric[e] < CONV_RIP_INFINITY) {
+                g_rip_changed[e] = 1;
+            }
+        }
+    }
+}
+
+static void conv_rip_prefixes_changed(uint32_t router) {
+    conv_rip_set(router, router, g_topo.withdrawn[router] ? CONV_RIP_INFINITY : 1, (uint16_t)router);
+}
+
+static uint32_t conv_rip_verify(void) {
+    uint32_t inconsistent = 0;
+
+    for (uint32_t p = 0; p < g_topo.routers * g_topo.prefixes; p++) {
+        uint32_t owner = conv_prefix_owner(p);
+        size_t e = conv_rip_entry(g_topo.root, owner);
+        uint16_t via = g_rip_via[e];
+
+        if (owner == g_topo.root) {
+            continue;
+        }
+        if (!conv_fib_matches(p, &via, g_rip_metric[e] < CONV_RIP_INFINITY ? 1 : 0)) {
+            inconsistent++;
+        }
+    }
+    return inconsistent;
+}
+
+static void conv_rip_teardown(void) {
+    free(g_rip_metric);
+    free(g_rip_via);
+    free(g_rip_changed);
+    free(g_rip_sending);
+    free(g_rip_installed);
+    free(g_rip_installed_via);
+    g_rip_metric = NULL;
+    g_rip_via = NULL;
+    g_rip_changed = NULL;
+    g_rip_sending = NULL;
+    g_rip_installed = NULL;
+    g_rip_installed_via = NULL;
+}
+
+static const conv_ops_t g_protocol_ops[CONV_PROTO_COUNT] = {
+    [CONV_PROTO_OSPF] = { conv_ospf_bringup, conv_ospf_link_changed, conv_ospf_prefixes_changed,
+                          conv_ospf_converge, conv_ospf_verify, conv_ospf_teardown },
+    [CONV_PROTO_RIP] = { conv_rip_bringup, conv_rip_link_changed, conv_rip_prefixes_changed,
+                         conv_rip_converge, conv_rip_verify, conv_rip_teardown },
+};
+
+/* ----------------------------------------------------------------------------
+ * Events
+ * ------------------------------------------------------------------------- */
+
+static void conv_set_link(const conv_ops_t *ops, uint32_t link, bool up) {
+    const conv_link_t *l = &g_topo.link[link];
+
+    __atomic_store_n(&g_topo.link[link].up, up, __ATOMIC_RELAXED);
+    if (l->a == g_topo.root || l->b == g_topo.root) {
+        conv_root_link_state(link, up);
+    }
+    ops->link_changed(link);
+}
+
+/* A link of the switch for local, one between two other routers otherwise */
+static uint32_t conv_pick_link(bool local, uint64_t *seed) {
+    for (;;) {
+        uint32_t link = (uint32_t)(bench_rand(seed) % g_topo.links);
+        bool is_local = g_topo.link[link].a == g_topo.root || g_topo.link[link].b == g_topo.root;
+        if (is_local == local) {
+            return link;
+        }
+    }
+}
+
+static uint32_t conv_pick_router(uint64_t *seed) {
+    for (;;) {
+        uint32_t router = (uint32_t)(bench_rand(seed) % g_topo.routers);
+        if (router != g_topo.root) {
+            return router;
+        }
+    }
+}
+
+static void conv_event(const conv_config_t *config, const conv_ops_t *ops, conv_event_t event, uint32_t target,
+                       conv_report_t *report) {
+    conv_sample_t sample;
+    uint32_t inconsistent;
+
+    conv_sample_begin(config, &sample);
+    switch (event) {
+    case CONV_EVENT_LINK_DOWN_LOCAL:
+    case CONV_EVENT_LINK_DOWN_REMOTE:
+        conv_set_link(ops, target, false);
+        break;
+    case CONV_EVENT_LINK_UP_LOCAL:
+    case CONV_EVENT_LINK_UP_REMOTE:
+        conv_set_link(ops, target, true);
+        break;
+    case CONV_EVENT_WITHDRAW:
+        /* Traffic to the prefixes stops counting now; it has nowhere to go */
+        __atomic_store_n(&g_topo.withdrawn[target], true, __ATOMIC_RELAXED);
+        ops->prefixes_changed(target);
+        break;
+    case CONV_EVENT_ADVERTISE:
+        /* And counts again: until the routes are in, it is lost */
+        __atomic_store_n(&g_topo.withdrawn[target], false, __ATOMIC_RELAXED);
+        ops->prefixes_changed(target);
+        break;
+    default:
+        break;
+    }
+    ops->converge(config, &sample);
+    inconsistent = ops->verify();
+    conv_sample_end(config, &sample, inconsistent, &report->events[event]);
+    if (inconsistent > 0) {
+        fprintf(stderr, "%s %s: %u prefixes inconsistent with the protocol\n", g_protocol_names[report->protocol],
+                g_event_names[event], inconsistent);
+    }
+}
+
+static status_t conv_run_protocol(const conv_config_t *settings, conv_protocol_t protocol, conv_report_t *report) {
+    const conv_ops_t *ops = &g_protocol_ops[protocol];
+    conv_config_t run = *settings;
+    const conv_config_t *config = &run;
+    uint64_t seed = settings->seed ^ 0x9E3779B97F4A7C15ULL;
+    conv_sample_t sample;
+    status_t status;
+
+    memset(report, 0, sizeof(*report));
+    report->protocol = protocol;
+    if (!routing_table_get_instance()) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if ((status = conv_build_topology(config)) != STATUS_SUCCESS) {
+        conv_free_topology();
+        return status;
+    }
+
+    /* Traffic runs from the start, so bring-up loss is the time to first routes */
+    run.traffic_threads = conv_traffic_start(settings->traffic_threads);
+
+    conv_sample_begin(config, &sample);
+    status = ops->bringup(config, &sample);
+    if (status == STATUS_SUCCESS) {
+        conv_sample_end(config, &sample, ops->verify(), &report->events[CONV_EVENT_BRINGUP]);
+        for (uint32_t c = 0; c < config->cycles; c++) {
+            uint32_t local = conv_pick_link(true, &seed);
+            uint32_t remote = conv_pick_link(false, &seed);
+            uint32_t router = conv_pick_router(&seed);
+
+            conv_event(config, ops, CONV_EVENT_LINK_DOWN_LOCAL, local, report);
+            conv_event(config, ops, CONV_EVENT_LINK_UP_LOCAL, local, report);
+            conv_event(config, ops, CONV_EVENT_LINK_DOWN_REMOTE, remote, report);
+            conv_event(config, ops, CONV_EVENT_LINK_UP_REMOTE, remote, report);
+            conv_event(config, ops, CONV_EVENT_WITHDRAW, router, report);
+            conv_event(config, ops, CONV_EVENT_ADVERTISE, router, report);
+        }
+    } else {
+        fprintf(stderr, "%s bring-up failed: %d\n", g_protocol_names[protocol], status);
+    }
+
+    conv_traffic_stop(run.traffic_threads);
+    ops->teardown();
+    routing_table_cleanup();
+    conv_free_topology();
+    return status;
+}
+
+/* ----------------------------------------------------------------------------
+ * Report
+ * ------------------------------------------------------------------------- */
+
+static int conv_compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double conv_percentile(conv_metrics_t *metrics, double q) {
+    if (metrics->count == 0) {
+        return 0;
+    }
+    qsort(metrics->convergence_us, metrics->count, sizeof(double), conv_compare_double);
+    return metrics->convergence_us[(uint32_t)((double)(metrics->count - 1) * q)];
+}
+
+static double conv_install_rate(const conv_metrics_t *metrics) {
+    return metrics->install_ns ? (double)metrics->installs * 1e9 / (double)metrics->install_ns : 0;
+}
+
+static double conv_loss_ratio(const conv_metrics_t *metrics) {
+    return metrics->sent ? (double)metrics->lost / (double)metrics->sent : 0;
+}
+
+static void conv_print(const conv_config_t *config, conv_report_t *report) {
+    printf("\n%s, %s of %u routers, %u prefixes each%s\n", g_protocol_names[report->protocol],
+           config->ring ? "ring" : "grid", config->routers, config->prefixes, config->lfa ? ", LFA" : "");
+    printf("%-17s %5s %11s %11s %11s %11s %11s %11s %8s %11s %9s %7s\n", "event", "count", "conv-p50-us",
+           "conv-p99-us", "conv-max-us", "cpu-mean-us", "cpu-max-us",
+           report->protocol == CONV_PROTO_OSPF ? "full/part" : "rounds-max", "routes", "install/s", "lost",
+           "loss%");
+    for (uint32_t e = 0; e < CONV_EVENT_COUNT; e++) {
+        conv_metrics_t *m = &report->events[e];
+        char runs[24];
+
+        if (m->count == 0) {
+            continue;
+        }
+        if (report->protocol == CONV_PROTO_OSPF) {
+            snprintf(runs, sizeof(runs), "%lu/%lu", (unsigned long)m->full_runs, (unsigned long)m->partial_runs);
+        } else {
+            snprintf(runs, sizeof(runs), "%u", m->rounds_max);
+        }
+        printf("%-17s %5u %11.1f %11.1f %11.1f %11.1f %11.1f %11s %8lu %11.0f %9lu %7.3f\n", g_event_names[e],
+               m->count, conv_percentile(m, 0.5), conv_percentile(m, 0.99), conv_percentile(m, 1.0),
+               m->compute_us / m->count, m->compute_max_us, runs, (unsigned long)m->routes_changed,
+               conv_install_rate(m), (unsigned long)m->lost, conv_loss_ratio(m) * 100.0);
+    }
+    fflush(stdout);
+}
+
+static int conv_write_csv(const char *path, const conv_config_t *config, conv_report_t *reports, uint32_t count) {
+    FILE *out = fopen(path, "w");
+
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    fprintf(out, "label,protocol,event,count,convergence_p50_us,convergence_p99_us,convergence_max_us,"
+            "cpu_mean_us,cpu_max_us,spf_full_runs,spf_partial_runs,rounds_max,routes_changed,installs,"
+            "install_rate,sent,lost,loss_ratio,inconsistent\n");
+    for (uint32_t r = 0; r < count; r++) {
+        for (uint32_t e = 0; e < CONV_EVENT_COUNT; e++) {
+            conv_metrics_t *m = &reports[r].events[e];
+            if (m->count == 0) {
+                continue;
+            }
+            fprintf(out, "%s,%s,%s,%u,%.1f,%.1f,%.1f,%.2f,%.2f,%lu,%lu,%u,%lu,%lu,%.0f,%lu,%lu,%.6f,%u\n",
+                    config->label, g_protocol_names[reports[r].protocol], g_event_names[e], m->count,
+                    conv_percentile(m, 0.5), conv_percentile(m, 0.99), conv_percentile(m, 1.0),
+                    m->compute_us / m->count, m->compute_max_us, (unsigned long)m->full_runs,
+                    (unsigned long)m->partial_runs, m->rounds_max, (unsigned long)m->routes_changed,
+                    (unsigned long)m->installs, conv_install_rate(m), (unsigned long)m->sent,
+                    (unsigned long)m->lost, conv_loss_ratio(m), m->inconsistent);
+        }
+    }
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+static int conv_write_json(const char *path, const conv_config_t *config, conv_report_t *reports, uint32_t count) {
+    FILE *out = fopen(path, "w");
+    char host[256] = "";
+
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    gethostname(host, sizeof(host) - 1);
+
+    fprintf(out, "{\n  \"context\": {\"label\": \"%s\", \"host\": \"%s\", \"date\": %ld, \"compiler\": \"%s\", "
+            "\"topology\": \"%s\", \"routers\": %u, \"prefixes\": %u, \"cycles\": %u, \"seed\": %lu, "
+            "\"lfa\": %s, \"spf_delay_ms\": %u, \"rip_delay_ms\": %u, \"traffic_threads\": %u},\n"
+            "  \"protocols\": [\n",
+            config->label, host, (long)time(NULL), __VERSION__, config->ring ? "ring" : "grid", config->routers,
+            config->prefixes, config->cycles, (unsigned long)config->seed, config->lfa ? "true" : "false",
+            config->spf_delay_ms, config->rip_delay_ms, config->traffic_threads);
+    for (uint32_t r = 0; r < count; r++) {
+        bool first = true;
+
+        fprintf(out, "    {\"protocol\": \"%s\", \"events\": [\n", g_protocol_names[reports[r].protocol]);
+        for (uint32_t e = 0; e < CONV_EVENT_COUNT; e++) {
+            conv_metrics_t *m = &reports[r].events[e];
+            if (m->count == 0) {
+                continue;
+            }
+            fprintf(out, "%s      {\"event\": \"%s\", \"count\": %u, \"convergence_p50_us\": %.1f, "
+                    "\"convergence_p99_us\": %.1f, \"convergence_max_us\": %.1f, \"cpu_mean_us\": %.2f, "
+                    "\"cpu_max_us\": %.2f, \"spf_full_runs\": %lu, \"spf_partial_runs\": %lu, \"rounds_max\": %u, "
+                    "\"routes_changed\": %lu, \"installs\": %lu, \"install_rate\": %.0f, \"sent\": %lu, "
+                    "\"lost\": %lu, \"loss_ratio\": %.6f, \"inconsistent\": %u}",
+                    first ? "" : ",\n", g_event_names[e], m->count, conv_percentile(m, 0.5),
+                    conv_percentile(m, 0.99), conv_percentile(m, 1.0), m->compute_us / m->count, m->compute_max_us,
+                    (unsigned long)m->full_runs, (unsigned long)m->partial_runs, m->rounds_max,
+                    (unsigned long)m->routes_changed, (unsigned long)m->installs, conv_install_rate(m),
+                    (unsigned long)m->sent, (unsigned long)m->lost, conv_loss_ratio(m), m->inconsistent);
+            first = false;
+        }
+        fprintf(out, "\n    ]}%s\n", r + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Event types that converged too slowly or left the FIB inconsistent
+ */
+static uint32_t conv_check(const conv_config_t *config, conv_report_t *reports, uint32_t count) {
+    uint32_t failed = 0;
+
+    for (uint32_t r = 0; r < count; r++) {
+        for (uint32_t e = 0; e < CONV_EVENT_COUNT; e++) {
+            conv_metrics_t *m = &reports[r].events[e];
+            double p99_ms = conv_percentile(m, 0.99) / 1000.0;
+
+            if (m->inconsistent > 0) {
+                failed++;
+            } else if (config->max_convergence_ms > 0 && p99_ms > config->max_convergence_ms) {
+                fprintf(stderr, "%s %s: p99 convergence %.3f ms, allowed %.3f ms\n",
+                        g_protocol_names[reports[r].protocol], g_event_names[e], p99_ms, config->max_convergence_ms);
+                failed++;
+            }
+        }
+    }
+    return failed;
+}
+
+static void conv_usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--protocol=ospf|rip|all] [--topology=grid|ring] [--routers=N] [--prefixes=N]\n"
+            "          [--cycles=N] [--seed=N] [--lfa] [--spf-delay-ms=N] [--rip-delay-ms=N] [--traffic=N]\n"
+            "          [--label=NAME] [--csv=FILE] [--json=FILE] [--max-convergence-ms=X]\n", prog);
+}
+
+static bool conv_parse_protocol(const char *name, conv_config_t *config) {
+    memset(config->protocols, 0, sizeof(config->protocols));
+    if (strcmp(name, "all") == 0) {
+        for (uint32_t p = 0; p < CONV_PROTO_COUNT; p++) {
+            config->protocols[p] = true;
+        }
+        return true;
+    }
+    for (uint32_t p = 0; p < CONV_PROTO_COUNT; p++) {
+        if (strcmp(name, g_protocol_names[p]) == 0) {
+            config->protocols[p] = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Hops of the longest shortest path, which RIP cannot take past 15 */
+static uint32_t conv_diameter(const conv_config_t *config) {
+    uint32_t width = 1;
+
+    if (config->ring) {
+        return config->routers / 2;
+    }
+    while ((width + 1) * (width + 1) <= config->routers) {
+        width++;
+    }
+    return (width - 1) + (config->routers + width - 1) / width - 1;
+}
+
+int main(int argc, char **argv) {
+    conv_config_t config = {
+        .protocols = { true, true },
+        .routers = 64,
+        .prefixes = 16,
+        .cycles = 10,
+        .seed = 1,
+        .traffic_threads = 1,
+        .label = "default",
+    };
+    static conv_report_t reports[CONV_PROTO_COUNT];
+    uint32_t count = 0;
+    int rc = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool ok = true;
+
+        if (strncmp(arg, "--protocol=", 11) == 0) {
+            ok = conv_parse_protocol(arg + 11, &config);
+        } else if (strncmp(arg, "--topology=", 11) == 0) {
+            config.ring = strcmp(arg + 11, "ring") == 0;
+            ok = config.ring || strcmp(arg + 11, "grid") == 0;
+        } else if (strncmp(arg, "--routers=", 10) == 0) {
+            config.routers = (uint32_t)strtoul(arg + 10, NULL, 10);
+            ok = config.routers >= 4 && config.routers <= CONV_MAX_ROUTERS;
+        } else if (strncmp(arg, "--prefixes=", 11) == 0) {
+            config.prefixes = (uint32_t)strtoul(arg + 11, NULL, 10);
+            ok = config.prefixes > 0;
+        } else if (strncmp(arg, "--cycles=", 9) == 0) {
+            config.cycles = (uint32_t)strtoul(arg + 9, NULL, 10);
+        } else if (strncmp(arg, "--seed=", 7) == 0) {
+            config.seed = strtoull(arg + 7, NULL, 10);
+            ok = config.seed != 0;
+        } else if (strcmp(arg, "--lfa") == 0) {
+            config.lfa = true;
+        } else if (strncmp(arg, "--spf-delay-ms=", 15) == 0) {
+            config.spf_delay_ms = (uint32_t)strtoul(arg + 15, NULL, 10);
+        } else if (strncmp(arg, "--rip-delay-ms=", 15) == 0) {
+            config.rip_delay_ms = (uint32_t)strtoul(arg + 15, NULL, 10);
+        } else if (strncmp(arg, "--traffic=", 10) == 0) {
+            config.traffic_threads = (uint32_t)strtoul(arg + 10, NULL, 10);
+            ok = config.traffic_threads <= CONV_MAX_TRAFFIC;
+        } else if (strncmp(arg, "--label=", 8) == 0) {
+            config.label = arg + 8;
+        } else if (strncmp(arg, "--csv=", 6) == 0) {
+            config.csv = arg + 6;
+        } else if (strncmp(arg, "--json=", 7) == 0) {
+            config.json = arg + 7;
+        } else if (strncmp(arg, "--max-convergence-ms=", 21) == 0) {
+            config.max_convergence_ms = strtod(arg + 21, NULL);
+            ok = config.max_convergence_ms > 0;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            conv_usage(argv[0]);
+            return 2;
+        }
+    }
+    if ((uint64_t)config.routers * config.prefixes > CONV_MAX_PREFIXES) {
+        fprintf(stderr, "At most %u prefixes in all\n", CONV_MAX_PREFIXES);
+        return 2;
+    }
+    if (config.protocols[CONV_PROTO_RIP] && conv_diameter(&config) >= CONV_RIP_INFINITY - 1) {
+        fprintf(stderr, "The topology is %u hops across, more than RIP reaches; RIP skipped\n",
+                conv_diameter(&config));
+        config.protocols[CONV_PROTO_RIP] = false;
+    }
+
+    /* Every route added logs, which would be timed along with it */
+    bench_init_logging(LOG_LEVEL_FATAL);
+
+    for (uint32_t p = 0; p < CONV_PROTO_COUNT; p++) {
+        if (config.protocols[p] && conv_run_protocol(&config, (conv_protocol_t)p, &reports[count]) == STATUS_SUCCESS) {
+            conv_print(&config, &reports[count]);
+            count++;
+        }
+    }
+
+    if (config.csv && conv_write_csv(config.csv, &config, reports, count) != 0) {
+        rc = 1;
+    }
+    if (config.json && conv_write_json(config.json, &config, reports, count) != 0) {
+        rc = 1;
+    }
+    if (conv_check(&config, reports, count) > 0) {
+        rc = 1;
+    }
+    return rc;
+}
@@ -0,0 +1,219 @@
+/**
+ * @file bench_l2.c
+ * @brief MAC table and VLAN classification benchmarks
+ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/types.h"
+#include "hal/packet.h"
+#include "hal/port.h"
+#include "l2/mac_table.h"
+#include "l2/vlan.h"
+
+#define BENCH_MAC_VLAN          10
+#define BENCH_MAC_PORTS         16
+#define BENCH_ACCESS_PORT       1
+#define BENCH_TRUNK_PORT        2
+
+/**
+ * @brief Keys of a MAC table benchmark
+ */
+typedef struct {
+    mac_addr_t *macs;
+    uint32_t count;
+    uint32_t churn_next;        /* Oldest key of the churn benchmark */
+} bench_mac_ctx_t;
+
+/**
+ * @brief Key number i as a locally administered unicast address
+ */
+static mac_addr_t bench_mac(uint32_t i) {
+    mac_addr_t mac = { .addr = { 0x02, 0x00, (uint8_t)(i >> 24), (uint8_t)(i >> 16),
+                                 (uint8_t)(i >> 8), (uint8_t)i } };
+    return mac;
+}
+
+static void bench_mac_lookup(bench_thread_t *t) {
+    const bench_mac_ctx_t *ctx = t->ctx;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (t->thread_index + 1);
+    port_id_t port;
+
+    for (uint64_t i = 0; i < t->iterations; i++) {
+        uint32_t key = (uint32_t)(bench_rand(&seed) % ctx->count);
+        if (mac_table_lookup(ctx->macs[key], BENCH_MAC_VLAN, &port) == STATUS_SUCCESS) {
+            t->sink += port;
+        }
+    }
+}
+
+/* Learning hits: entries already in the table are refreshed */
+static void bench_mac_add(bench_thread_t *t) {
+    const bench_mac_ctx_t *ctx = t->ctx;
+    uint32_t share = ctx->count / t->thread_count;
+    uint32_t first = share * t->thread_index;
+
+    for (uint64_t i = 0; i < t->iterations; i++) {
+        uint32_t key = first + (uint32_t)(i % share);
+        t->sink += mac_table_add(ctx->macs[key], (port_id_t)(key % BENCH_MAC_PORTS + 1),
+                                 BENCH_MAC_VLAN, false) == STATUS_SUCCESS;
+    }
+}
+
+/* Churn: learn a new address and delete the oldest one, so the table keeps its size */
+static void bench_mac_churn(bench_thread_t *t) {
+    bench_mac_ctx_t *ctx = t->ctx;
+
+    for (uint64_t i = 0; i < t->iterations; i++) {
+        uint32_t oldest = ctx->churn_next++;
+        mac_addr_t fresh = bench_mac(ctx->count + oldest);
+        mac_addr_t stale = bench_mac(oldest);
+        t->sink += mac_table_add(fresh, (port_id_t)(oldest % BENCH_MAC_PORTS + 1), BENCH_MAC_VLAN, false) ==
+                   STATUS_SUCCESS;
+        mac_table_remove(stale, BENCH_MAC_VLAN);
+    }
+}
+
+void bench_suite_mac_table(const bench_config_t *config) {
+    static const uint32_t sizes[] = { 1024, 16384, 60000 };
+    uint32_t size_count = config->quick ? 1 : sizeof(sizes) / sizeof(sizes[0]);
+    char params[BENCH_PARAMS_MAX];
+
+    if (!bench_selected(config, "mac_table")) {
+        return;
+    }
+
+    for (uint32_t s = 0; s < size_count; s++) {
+        bench_mac_ctx_t ctx = { .count = sizes[s] };
+
+        if (port_init() != STATUS_SUCCESS || mac_table_init(CONFIG_MAX_MAC_TABLE_ENTRIES, 0) != STATUS_SUCCESS) {
+            fprintf(stderr, "port_init or mac_table_init failed\n");
+            return;
+        }
+        ctx.macs = malloc(sizeof(mac_addr_t) * ctx.count);
+        if (!ctx.macs) {
+            mac_table_deinit();
+            return;
+        }
+        for (uint32_t i = 0; i < ctx.count; i++) {
+            ctx.macs[i] = bench_mac(i);
+            mac_table_add(ctx.macs[i], (port_id_t)(i % BENCH_MAC_PORTS + 1), BENCH_MAC_VLAN, false);
+        }
+
+        snprintf(params, sizeof(params), "entries=%u", ctx.count);
+        for (uint32_t threads = 1; threads <= config->max_threads; threads *= 2) {
+            bench_run(config, "mac_table_lookup", params, bench_mac_lookup, &ctx, threads);
+        }
+        for (uint32_t threads = 1; threads <= config->max_threads; threads *= 2) {
+            bench_run(config, "mac_table_add", params, bench_mac_add, &ctx, threads);
+        }
+        bench_run(config, "mac_table_add_delete", params, bench_mac_churn, &ctx, 1);
+
+        free(ctx.macs);
+        mac_table_deinit();
+    }
+}
+
+/**
+ * @brief Frames of the VLAN classification benchmark
+ */
+typedef struct {
+    packet_buffer_t *untagged;
+    packet_buffer_t *tagged;
+} bench_vlan_ctx_t;
+
+static void bench_vlan_untagged(bench_thread_t *t) {
+    const bench_vlan_ctx_t *ctx = t->ctx;
+    vlan_id_t vlan_id;
+
+    for (uint64_t i = 0; i < t->iterations; i++) {
+        if (vlan_get_packet_vlan(BENCH_ACCESS_PORT, ctx->untagged, &vlan_id) == STATUS_SUCCESS) {
+            t->sink += vlan_id;
+        }
+    }
+}
+
+static void bench_vlan_tagged(bench_thread_t *t) {
+    const bench_vlan_ctx_t *ctx = t->ctx;
+    vlan_id_t vlan_id;
+
+    for (uint64_t i = 0; i < t->iterations; i++) {
+        if (vlan_get_packet_vlan(BENCH_TRUNK_PORT, ctx->tagged, &vlan_id) == STATUS_SUCCESS) {
+            t->sink += vlan_id;
+        }
+    }
+}
+
+/**
+ * @brief Build a 64-byte frame, with an 802.1Q tag if vlan_id is not 0
+ */
+static packet_buffer_t *bench_frame(vlan_id_t vlan_id) {
+    uint8_t frame[64] = { 0x02, 0, 0, 0, 0, 0x01, 0x02, 0, 0, 0, 0, 0x02 };
+    uint32_t offset = 12;
+    packet_buffer_t *packet = packet_buffer_alloc(sizeof(frame));
+
+    if (!packet) {
+        return NULL;
+    }
+    if (vlan_id) {
+        frame[offset++] = ETHERTYPE_VLAN >> 8;
+        frame[offset++] = ETHERTYPE_VLAN & 0xff;
+        frame[offset++] = (uint8_t)(vlan_id >> 8);
+        frame[offset++] = (uint8_t)vlan_id;
+    }
+    frame[offset++] = 0x08;
+    frame[offset] = 0x00;
+    memcpy(packet->data, frame, sizeof(frame));
+    packet->length = sizeof(frame);
+    return packet;
+}
+
+void bench_suite_vlan(const bench_config_t *config) {
+    vlan_port_config_t access = {
+        .mode = VLAN_PORT_MODE_ACCESS, .pvid = BENCH_MAC_VLAN, .native_vlan = BENCH_MAC_VLAN,
+        .accept_untag = true, .accept_tag = false, .ingress_filter = true,
+    };
+    vlan_port_config_t trunk = {
+        .mode = VLAN_PORT_MODE_TRUNK, .pvid = 1, .native_vlan = 1,
+        .accept_untag = false, .accept_tag = true, .ingress_filter = true,
+    };
+    bench_vlan_ctx_t ctx;
+
+    if (!bench_selected(config, "vlan_get_packet_vlan")) {
+        return;
+    }
+
+    if (packet_init() != STATUS_SUCCESS || port_init() != STATUS_SUCCESS || vlan_init(BENCH_MAC_PORTS) != STATUS_SUCCESS) {
+        fprintf(stderr, "packet_init, port_init or vlan_init failed\n");
+        return;
+    }
+    vlan_create(BENCH_MAC_VLAN, "bench");
+    vlan_add_port(BENCH_MAC_VLAN, BENCH_ACCESS_PORT, VLAN_MEMBER_UNTAGGED);
+    vlan_add_port(BENCH_MAC_VLAN, BENCH_TRUNK_PORT, VLAN_MEMBER_TAGGED);
+    vlan_set_port_config(BENCH_ACCESS_PORT, &access);
+    vlan_set_port_config(BENCH_TRUNK_PORT, &trunk);
+
+    ctx.untagged = bench_frame(0);
+    ctx.tagged = bench_frame(BENCH_MAC_VLAN);
+    if (ctx.untagged && ctx.tagged) {
+        for (uint32_t threads = 1; threads <= config->max_threads; threads *= 2) {
+            bench_run(config, "vlan_get_packet_vlan", "frame=untagged", bench_vlan_untagged, &ctx, threads);
+        }
+        for (uint32_t threads = 1; threads <= config->max_threads; threads *= 2) {
+            bench_run(config, "vlan_get_packet_vlan", "frame=tagged", bench_vlan_tagged, &ctx, threads);
+        }
+    }
+
+    if (ctx.untagged) {
+        packet_buffer_free(ctx.untagged);
+    }
+    if (ctx.tagged) {
+        packet_buffer_free(ctx.tagged);
+    }
+    vlan_deinit();
+    packet_shutdown();
+}
@@ -0,0 +1,198 @@
+/**
+ * @file bench_l3.c
+ * @brief Routing and ARP lookup benchmarks
+ */
+
+#include "bench.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/types.h"
+#include "l3/arp.h"
+#include "l3/ip.h"
+#include "l3/routing_table.h"
+
+#define BENCH_ROUTE_INTERFACES  48
+#define BENCH_HOT_PERCENT       90      /* Lookups of the skewed benchmark that go to the hot prefixes */
+#define BENCH_HOT_SHARE         100     /* One prefix in this many is hot */
+
+/**
+ * @brief Installed prefixes of a routing benchmark
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t hot_count;
+} bench_route_ctx_t;
+
+/**
+ * @brief Network of /24 number i, host order: 10.0.0.0/24 upward, then 11.0.0.0 ...
+ */
+static inline uint32_t bench_route_network(uint32_t i) {
+    return ((10U + (i >> 16)) << 24) | ((i & 0xffffU) << 8);
+}
+
+static inline void bench_route_lookup_one(bench_thread_t *t, uint32_t prefix, uint64_t r) {
+    ip_addr_t dst = { .type = IP_TYPE_V4 };
+    ip_addr_t next_hop;
+    uint16_t interface_index;
+
+    dst.addr.v4 = htonl(bench_route_network(prefix) | (uint32_t)(r & 0xff));
+    if (routing_lookup_nexthop(&dst, IP_TYPE_V4, (uint32_t)r, &next_hop, &interface_index) == STATUS_SUCCESS) {
+        t->sink += interface_index;
+    }
+}
+
+/* Uniform over every installed prefix */
+static void bench_route_random(bench_thread_t *t) {
+    const bench_route_ctx_t *ctx = t->ctx;
+    uint64_t seed = 0xD1B54A32D192ED03ULL * (t->thread_index + 1);
+
+    for (uint64_t i = 0; i < t->iterations; i++) {
+        uint64_t r = bench_rand(&seed);
+        bench_route_lookup_one(t, (uint32_t)((r >> 8) % ctx->count), r);
+    }
+}
+
+/* Most lookups go to a small hot set of prefixes, as real traffic does */
+static void bench_route_skewed(bench_thread_t *t) {
+    const bench_route_ctx_t *ctx = t->ctx;
+    uint64_t seed = 0xD1B54A32D192ED03ULL * (t->thread_index + 1);
+
+    for (uint64_t i = 0; i < t->iterations; i++) {
+        uint64_t r = bench_rand(&seed);
+        bool hot = (r >> 40) % 100 < BENCH_HOT_PERCENT;
+        uint32_t prefix = (uint32_t)((r >> 8) % (hot ? ctx->hot_count : ctx->count));
+        bench_route_lookup_one(t, prefix, r);
+    }
+}
+
+/**
+ * @brief Install count /24 routes through one bulk add
+ */
+static status_t bench_route_fill(uint32_t count) {
+    routing_route_t *routes = calloc(count, sizeof(routing_route_t));
+    uint32_t added = 0;
+    status_t status;
+
+    if (!routes) {
+        return STATUS_NO_MEMORY;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        routes[i].type = IP_TYPE_V4;
+        routes[i].prefix.type = IP_TYPE_V4;
+        routes[i].prefix.addr.v4 = htonl(bench_route_network(i));
+        routes[i].prefix_len = 24;
+        routes[i].next_hop.type = IP_TYPE_V4;
+        routes[i].next_hop.addr.v4 = htonl(0xC0A80001U | ((i % 16) << 8));
+        routes[i].interface_index = (uint16_t)(i % BENCH_ROUTE_INTERFACES + 1);
+        routes[i].source = ROUTE_TYPE_STATIC;
+    }
+
+    status = routing_table_add_routes(routes, count, &added);
+    free(routes);
+    if (status == STATUS_SUCCESS && added != count) {
+        status = STATUS_FAILURE;
+    }
+    return status;
+}
+
+void bench_suite_routing(const bench_config_t *config) {
+    static const uint32_t sizes[] = { 1024, 65536, 524288 };
+    uint32_t size_count = config->quick ? 1 : sizeof(sizes) / sizeof(sizes[0]);
+    char params[BENCH_PARAMS_MAX];
+
+    if (!bench_selected(config, "routing_lookup")) {
+        return;
+    }
+
+    for (uint32_t s = 0; s < size_count; s++) {
+        bench_route_ctx_t ctx = { .count = sizes[s], .hot_count = sizes[s] / BENCH_HOT_SHARE };
+
+        if (ctx.hot_count == 0) {
+            ctx.hot_count = 1;
+        }
+        if (!routing_table_get_instance() || bench_route_fill(ctx.count) != STATUS_SUCCESS) {
+            fprintf(stderr, "Failed to install %u routes\n", ctx.count);
+            routing_table_cleanup();
+            return;
+        }
+
+        snprintf(params, sizeof(params), "routes=%u,uniform", ctx.count);
+        for (uint32_t threads = 1; threads <= config->max_threads; threads *= 2) {
+            bench_run(config, "routing_lookup", params, bench_route_random, &ctx, threads);
+        }
+        snprintf(params, sizeof(params), "routes=%u,hot=%u%%", ctx.count, BENCH_HOT_PERCENT);
+        for (uint32_t threads = 1; threads <= config->max_threads; threads *= 2) {
+            bench_run(config, "routing_lookup", params, bench_route_skewed, &ctx, threads);
+        }
+
+        routing_table_cleanup();
+    }
+}
+
+/**
+ * @brief Resolved neighbors of an ARP benchmark
+ */
+typedef struct {
+    arp_table_t *table;
+    uint32_t count;
+} bench_arp_ctx_t;
+
+static inline ipv4_addr_t bench_arp_address(uint32_t i) {
+    return 0x0A800000U + i;     /* 10.128.0.0 upward */
+}
+
+static void bench_arp_lookup(bench_thread_t *t) {
+    const bench_arp_ctx_t *ctx = t->ctx;
+    uint64_t seed = 0x94D049BB133111EBULL * (t->thread_index + 1);
+    mac_addr_t mac;
+    uint16_t port;
+
+    for (uint64_t i = 0; i < t->iterations; i++) {
+        ipv4_addr_t address = bench_arp_address((uint32_t)(bench_rand(&seed) % ctx->count));
+        if (arp_lookup(ctx->table, &address, &mac, &port) == STATUS_SUCCESS) {
+            t->sink += mac.addr[5];
+        }
+    }
+}
+
+void bench_suite_arp(const bench_config_t *config) {
+    static const uint32_t sizes[] = { 256, 4096, 32768 };
+    uint32_t size_count = config->quick ? 1 : sizeof(sizes) / sizeof(sizes[0]);
+    char params[BENCH_PARAMS_MAX];
+
+    if (!bench_selected(config, "arp_lookup")) {
+        return;
+    }
+
+    for (uint32_t s = 0; s < size_count; s++) {
+        bench_arp_ctx_t ctx = { .table = arp_table_get_instance(), .count = sizes[s] };
+
+        if (arp_init(ctx.table) != STATUS_SUCCESS) {
+            fprintf(stderr, "arp_init failed\n");
+            return;
+        }
+        for (uint32_t i = 0; i < ctx.count; i++) {
+            ipv4_addr_t address = bench_arp_address(i);
+            mac_addr_t mac = { .addr = { 0x02, 0x01, 0, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i } };
+            if (arp_add_entry(ctx.table, &address, &mac, (uint16_t)(i % BENCH_ROUTE_INTERFACES + 1)) !=
+                STATUS_SUCCESS) {
+                fprintf(stderr, "ARP table took only %u of %u neighbors\n", i, ctx.count);
+                ctx.count = i;
+                break;
+            }
+        }
+
+        if (ctx.count > 0) {
+            snprintf(params, sizeof(params), "entries=%u", ctx.count);
+            for (uint32_t threads = 1; threads <= config->max_threads; threads *= 2) {
+                bench_run(config, "arp_lookup", params, bench_arp_lookup, &ctx, threads);
+            }
+        }
+
+        arp_deinit(ctx.table);
+    }
+}
@@ -0,0 +1,340 @@
+/**
+ * @file bench_main.c
+ * @brief Microbenchmark harness and driver
+ *
+ * Usage: switch-bench [--json=FILE] [--filter=NAME] [--min-time-ms=N]
+ *                     [--repetitions=N] [--threads=N] [--quick] [--no-perf]
+ */
+
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/logging.h"
+
+/**
+ * @brief Threads of one run and their start barrier
+ */
+typedef struct {
+    bench_fn_t fn;
+    bool perf;
+    pthread_barrier_t barrier;
+    bench_thread_t work[BENCH_MAX_THREADS];
+    uint64_t start_ns[BENCH_MAX_THREADS];
+    uint64_t end_ns[BENCH_MAX_THREADS];
+    uint64_t cycles[BENCH_MAX_THREADS];
+    bool counted[BENCH_MAX_THREADS];
+    perf_sample_t events[BENCH_MAX_THREADS];
+} bench_run_t;
+
+/**
+ * @brief Measurements of one run
+ */
+typedef struct {
+    double ns_per_op;
+    double cycles_per_op;
+    double mops;
+    uint64_t wall_ns;
+    bool has_events;
+    double events[PERF_COUNTER_COUNT];
+} bench_sample_t;
+
+static bench_result_t g_results[BENCH_MAX_RESULTS];
+static uint32_t g_result_count = 0;
+static volatile uint64_t g_sink;
+
+typedef struct {
+    bench_run_t *run;
+    uint32_t index;
+} bench_worker_arg_t;
+
+static void *bench_worker(void *arg) {
+    bench_worker_arg_t *worker = arg;
+    bench_run_t *run = worker->run;
+    uint32_t i = worker->index;
+    perf_counters_t *pc = run->perf ? perf_counters_thread() : NULL;
+    perf_sample_t before;
+    perf_sample_t after;
+
+    pthread_barrier_wait(&run->barrier);
+    /* The counter reads stay outside the timed part */
+    run->counted[i] = pc && perf_counters_read(pc, &before) == STATUS_SUCCESS;
+    run->start_ns[i] = bench_now_ns();
+    uint64_t c0 = bench_cycles();
+    run->fn(&run->work[i]);
+    run->cycles[i] = bench_cycles() - c0;
+    run->end_ns[i] = bench_now_ns();
+    if (run->counted[i]) {
+        run->counted[i] = perf_counters_read(pc, &after) == STATUS_SUCCESS;
+        perf_sample_delta(&before, &after, &run->events[i]);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Run iterations operations on each of threads threads once
+ */
+static void bench_once(bench_fn_t fn, void *ctx, bool perf, uint32_t threads, uint64_t iterations,
+                       bench_sample_t *sample) {
+    static bench_run_t run;
+    pthread_t tids[BENCH_MAX_THREADS];
+    bench_worker_arg_t args[BENCH_MAX_THREADS];
+    uint64_t first_start = UINT64_MAX;
+    uint64_t last_end = 0;
+    double ns = 0;
+    double cycles = 0;
+    perf_sample_t events = { { 0 } };
+    uint32_t counted = 0;
+
+    run.fn = fn;
+    run.perf = perf;
+    pthread_barrier_init(&run.barrier, NULL, threads);
+    for (uint32_t i = 0; i < threads; i++) {
+        run.work[i] = (bench_thread_t){
+            .iterations = iterations,
+            .thread_index = i,
+            .thread_count = threads,
+            .ctx = ctx,
+        };
+        args[i] = (bench_worker_arg_t){ .run = &run, .index = i };
+    }
+
+    /* One thread runs on the caller, so single-threaded runs spawn nothing */
+    for (uint32_t i = 1; i < threads; i++) {
+        pthread_create(&tids[i], NULL, bench_worker, &args[i]);
+    }
+    bench_worker(&args[0]);
+    for (uint32_t i = 1; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    pthread_barrier_destroy(&run.barrier);
+
+    for (uint32_t i = 0; i < threads; i++) {
+        ns += (double)(run.end_ns[i] - run.start_ns[i]);
+        cycles += (double)run.cycles[i];
+        first_start = run.start_ns[i] < first_start ? run.start_ns[i] : first_start;
+        last_end = run.end_ns[i] > last_end ? run.end_ns[i] : last_end;
+        g_sink += run.work[i].sink;
+        if (run.counted[i]) {
+            perf_sample_add(&events, &run.events[i]);
+            counted++;
+        }
+    }
+
+    sample->wall_ns = last_end - first_start;
+    sample->ns_per_op = ns / threads / (double)iterations;
+    sample->cycles_per_op = cycles / threads / (double)iterations;
+    sample->mops = sample->wall_ns ? (double)iterations * threads * 1000.0 / (double)sample->wall_ns : 0;
+    sample->has_events = counted > 0;
+    for (uint32_t e = 0; e < PERF_COUNTER_COUNT; e++) {
+        sample->events[e] = counted ? (double)events.values[e] / counted / (double)iterations : 0;
+    }
+}
+
+static int bench_compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double bench_median(double *values, uint32_t count) {
+    qsort(values, count, sizeof(double), bench_compare_double);
+    return count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+/**
+ * @brief Events per operation as counts of a thousand operations, for the perf_sample_t helpers
+ */
+static void bench_events_sample(const bench_result_t *result, perf_sample_t *sample) {
+    for (uint32_t e = 0; e < PERF_COUNTER_COUNT; e++) {
+        sample->values[e] = (uint64_t)(result->events[e] * 1000.0);
+    }
+}
+
+bool bench_selected(const bench_config_t *config, const char *name) {
+    /* Suites check their name prefix, which a filter naming one of their benchmarks contains */
+    return !config->filter || strstr(name, config->filter) != NULL || strstr(config->filter, name) != NULL;
+}
+
+void bench_run(const bench_config_t *config, const char *name, const char *params,
+               bench_fn_t fn, void *ctx, uint32_t threads) {
+    bench_sample_t sample;
+    double ns[64];
+    double cycles[64];
+    double mops[64];
+    double events[PERF_COUNTER_COUNT][64];
+    bool has_events = true;
+    uint64_t iterations = 256;
+    uint64_t min_ns = (uint64_t)config->min_time_ms * 1000000ULL;
+    uint32_t repetitions = config->repetitions < 64 ? config->repetitions : 64;
+
+    if (!bench_selected(config, name) || threads == 0 || threads > BENCH_MAX_THREADS) {
+        return;
+    }
+
+    /* Grow the count until a run lasts the minimum time */
+    for (;;) {
+        bench_once(fn, ctx, false, threads, iterations, &sample);
+        if (sample.wall_ns >= min_ns || iterations >= (1ULL << 40)) {
+            break;
+        }
+        double scale = sample.wall_ns ? 1.4 * (double)min_ns / (double)sample.wall_ns : 16;
+        iterations = (uint64_t)((double)iterations * (scale < 2 ? 2 : (scale > 16 ? 16 : scale)));
+    }
+
+    for (uint32_t r = 0; r < repetitions; r++) {
+        bench_once(fn, ctx, config->perf, threads, iterations, &sample);
+        ns[r] = sample.ns_per_op;
+        cycles[r] = sample.cycles_per_op;
+        mops[r] = sample.mops;
+        has_events = has_events && sample.has_events;
+        for (uint32_t e = 0; e < PERF_COUNTER_COUNT; e++) {
+            events[e][r] = sample.events[e];
+        }
+    }
+
+    bench_result_t result = {
+        .threads = threads,
+        .iterations = iterations,
+        .ns_per_op = bench_median(ns, repetitions),
+        .cycles_per_op = bench_median(cycles, repetitions),
+        .mops = bench_median(mops, repetitions),
+        .has_events = has_events,
+    };
+    snprintf(result.name, sizeof(result.name), "%s", name);
+    snprintf(result.params, sizeof(result.params), "%s", params ? params : "");
+    for (uint32_t e = 0; has_events && e < PERF_COUNTER_COUNT; e++) {
+        result.events[e] = bench_median(events[e], repetitions);
+    }
+
+    printf("%-30s %-24s %3u %12.1f %12.1f %12.2f", result.name, result.params, result.threads,
+           result.ns_per_op, result.cycles_per_op, result.mops);
+    if (has_events) {
+        perf_sample_t per_op;
+        bench_events_sample(&result, &per_op);
+        printf(" %6.2f %9.1f %9.3f %9.3f %-7s", perf_sample_ipc(&per_op),
+               result.events[PERF_COUNTER_INSTRUCTIONS], result.events[PERF_COUNTER_CACHE_MISSES],
+               result.events[PERF_COUNTER_BRANCH_MISSES], perf_sample_bound(&per_op));
+    }
+    printf("\n");
+    fflush(stdout);
+
+    if (g_result_count < BENCH_MAX_RESULTS) {
+        g_results[g_result_count++] = result;
+    }
+}
+
+/**
+ * @brief Write the results as JSON
+ */
+static int bench_write_json(const char *path, const bench_config_t *config) {
+    FILE *out = fopen(path, "w");
+    char host[256] = "";
+
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    gethostname(host, sizeof(host) - 1);
+
+    fprintf(out, "{\n  \"context\": {\"host\": \"%s\", \"cpus\": %ld, \"date\": %ld, "
+            "\"min_time_ms\": %u, \"repetitions\": %u},\n  \"benchmarks\": [\n",
+            host, sysconf(_SC_NPROCESSORS_ONLN), (long)time(NULL),
+            config->min_time_ms, config->repetitions);
+    for (uint32_t i = 0; i < g_result_count; i++) {
+        const bench_result_t *r = &g_results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"params\": \"%s\", \"threads\": %u, \"iterations\": %llu, "
+                "\"ns_per_op\": %.3f, \"cycles_per_op\": %.3f, \"mops\": %.4f",
+                r->name, r->params, r->threads, (unsigned long long)r->iterations,
+                r->ns_per_op, r->cycles_per_op, r->mops);
+        if (r->has_events) {
+            perf_sample_t per_op;
+            bench_events_sample(r, &per_op);
+            fprintf(out, ", \"ipc\": %.3f, \"bound\": \"%s\", \"events_per_op\": {",
+                    perf_sample_ipc(&per_op), perf_sample_bound(&per_op));
+            for (uint32_t e = 0; e < PERF_COUNTER_COUNT; e++) {
+                fprintf(out, "%s\"%s\": %.4f", e ? ", " : "", perf_counter_name((perf_counter_t)e), r->events[e]);
+            }
+            fprintf(out, "}");
+        }
+        fprintf(out, "}%s\n", i + 1 < g_result_count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+static void bench_usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--json=FILE] [--filter=NAME] [--min-time-ms=N] [--repetitions=N]\n"
+            "          [--threads=N] [--quick] [--no-perf]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    static const bench_suite_fn_t suites[] = {
+        bench_suite_mac_table,
+        bench_suite_vlan,
+        bench_suite_routing,
+        bench_suite_arp,
+        bench_suite_packet,
+    };
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    bench_config_t config = {
+        .min_time_ms = 200,
+        .repetitions = 5,
+        .max_threads = cpus > 0 ? (uint32_t)(cpus < 8 ? cpus : 8) : 1,
+        .perf = true,
+    };
+    const char *json = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--json=", 7) == 0) {
+            json = argv[i] + 7;
+        } else if (strncmp(argv[i], "--filter=", 9) == 0) {
+            config.filter = argv[i] + 9;
+        } else if (strncmp(argv[i], "--min-time-ms=", 14) == 0) {
+            config.min_time_ms = (uint32_t)strtoul(argv[i] + 14, NULL, 10);
+        } else if (strncmp(argv[i], "--repetitions=", 14) == 0) {
+            config.repetitions = (uint32_t)strtoul(argv[i] + 14, NULL, 10);
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            config.max_threads = (uint32_t)strtoul(argv[i] + 10, NULL, 10);
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            config.quick = true;
+        } else if (strcmp(argv[i], "--no-perf") == 0) {
+            config.perf = false;
+        } else {
+            bench_usage(argv[0]);
+            return 2;
+        }
+    }
+    if (config.repetitions == 0 || config.repetitions > 63 ||
+        config.max_threads == 0 || config.max_threads > BENCH_MAX_THREADS) {
+        bench_usage(argv[0]);
+        return 2;
+    }
+
+    bench_init_logging(LOG_LEVEL_ERROR);
+
+    if (config.perf && !perf_counters_thread()) {
+        fprintf(stderr, "Hardware performance counters not available, timing only\n");
+        config.perf = false;
+    }
+    printf("%-30s %-24s %3s %12s %12s %12s", "benchmark", "params", "thr", "ns/op", "cycles/op", "Mops/s");
+    if (config.perf) {
+        printf(" %6s %9s %9s %9s %-7s", "ipc", "insns/op", "llc/op", "brmiss/op", "bound");
+    }
+    printf("\n");
+    for (size_t i = 0; i < sizeof(suites) / sizeof(suites[0]); i++) {
+        suites[i](&config);
+    }
+
+    if (json && bench_write_json(json, &config) != 0) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file bench_packet.c
+ * @brief Packet buffer pool and processor pipeline benchmarks
+ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common/types.h"
+#include "hal/packet.h"
+
+#define BENCH_PACKET_SIZE       64
+#define BENCH_MAX_PROCESSORS    16
+
+/**
+ * @brief Trivial processor: touches the frame and forwards it
+ */
+static packet_result_t bench_processor(packet_buffer_t *packet, void *user_data) {
+    (void)user_data;
+    packet->data[0] ^= 1;
+    return PACKET_RESULT_FORWARD;
+}
+
+static void bench_alloc_free(bench_thread_t *t) {
+    for (uint64_t i = 0; i < t->iterations; i++) {
+        packet_buffer_t *packet = packet_buffer_alloc(BENCH_PACKET_SIZE);
+        if (packet) {
+            t->sink += packet->size;
+            packet_buffer_free(packet);
+        }
+    }
+}
+
+/* Each thread pushes its own frame through the whole pipeline */
+static void bench_process(bench_thread_t *t) {
+    packet_buffer_t *packet = packet_buffer_alloc(BENCH_PACKET_SIZE);
+
+    if (!packet) {
+        return;
+    }
+    memset(packet->data, 0, BENCH_PACKET_SIZE);
+    packet->length = BENCH_PACKET_SIZE;
+    for (uint64_t i = 0; i < t->iterations; i++) {
+        t->sink += packet_process(packet) == PACKET_RESULT_FORWARD;
+    }
+    packet_buffer_free(packet);
+}
+
+void bench_suite_packet(const bench_config_t *config) {
+    static const uint32_t processor_counts[] = { 1, 4, 16 };
+    uint32_t handles[BENCH_MAX_PROCESSORS];
+    uint32_t registered = 0;
+    char params[BENCH_PARAMS_MAX];
+
+    if (!bench_selected(config, "packet_")) {
+        return;
+    }
+    if (packet_init() != STATUS_SUCCESS) {
+        fprintf(stderr, "packet_init failed\n");
+        return;
+    }
+
+    snprintf(params, sizeof(params), "size=%u", BENCH_PACKET_SIZE);
+    for (uint32_t threads = 1; threads <= config->max_threads; threads *= 2) {
+        bench_run(config, "packet_buffer_alloc_free", params, bench_alloc_free, NULL, threads);
+    }
+
+    for (size_t p = 0; p < sizeof(processor_counts) / sizeof(processor_counts[0]); p++) {
+        while (registered < processor_counts[p]) {
+            if (packet_register_processor(bench_processor, registered, NULL, &handles[registered]) !=
+                STATUS_SUCCESS) {
+                fprintf(stderr, "packet_register_processor failed\n");
+                goto out;
+            }
+            registered++;
+        }
+
+        snprintf(params, sizeof(params), "processors=%u", registered);
+        for (uint32_t threads = 1; threads <= config->max_threads; threads *= 2) {
+            bench_run(config, "packet_process", params, bench_process, NULL, threads);
+        }
+    }
+
+out:
+    while (registered > 0) {
+        packet_unregister_processor(handles[--registered]);
+    }
+    packet_shutdown();
+}
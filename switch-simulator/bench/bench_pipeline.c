@@ -0,0 +1,984 @@
+/**
+ * @file bench_pipeline.c
+ * @brief End-to-end forwarding throughput benchmark
+ *
+ * Builds a switch in memory - ports, one bridged VLAN, static MACs, routes
+ * and resolved next hops - and drives the hardware simulation RX path with
+ * frames generated from templates, without kernel interfaces. Frames go
+ * through the packet pipeline to hw_sim_transmit_burst() on the egress
+ * port, and the benchmark reports forwarded Mpps, the latency from RX
+ * enqueue to transmit and the drops by reason. In rtc mode, where the
+ * counters are available, it also reports hardware events per forwarded
+ * packet over the measurement window (common/perf_counters.h).
+ *
+ * Profiles:
+ *   l2     frames bridged to static MACs in the VLAN
+ *   l3     frames sent to the router MAC and routed to resolved next hops
+ *   mixed  both, --l3-percent routed
+ *
+ * Modes:
+ *   rtc     each worker owns one ingress port: it generates a burst, queues
+ *           it with hw_sim_rx_enqueue_burst() and runs it to completion
+ *           with hw_sim_rx_poll()
+ *   engine  one generator per ingress port feeds the RX rings and the
+ *           forwarding engine workers (forwarding.h) process them; RX ring
+ *           overruns show up as drops
+ *
+ * Usage: switch-pipeline-bench [--profile=l2|l3|mixed|all] [--mode=rtc|engine]
+ *            [--workers=N] [--generators=N] [--duration-ms=N] [--warmup-ms=N]
+ *            [--burst=N] [--size=N] [--flows=N] [--routes=N]
+ *            [--l3-percent=N] [--miss-percent=N] [--json=FILE]
+ */
+
+#include "bench.h"
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/logging.h"
+#include "common/perf_counters.h"
+#include "common/types.h"
+#include "hal/forwarding.h"
+#include "hal/hw_simulation.h"
+#include "hal/port.h"
+#include "hal/packet.h"
+#include "hal/packet_drop.h"
+#include "l2/mac_table.h"
+#include "l2/vlan.h"
+#include "l3/arp.h"
+#include "l3/ip.h"
+#include "l3/routing_table.h"
+
+#define PIPE_VLAN               10
+#define PIPE_NEXT_HOPS          64
+#define PIPE_MAX_PORTS          64
+#define PIPE_MAX_FLOWS          65536
+#define PIPE_MIN_FRAME          64
+#define PIPE_MAX_FRAME          1500
+#define PIPE_FORWARD_PRIORITY   1000    /* After the validation, punt and ACL stages */
+#define PIPE_HIST_SUB           16      /* Linear sub-buckets per power of two */
+#define PIPE_HIST_BUCKETS       (48 * PIPE_HIST_SUB)
+#define PIPE_MAX_SLOTS          (2 * BENCH_MAX_THREADS)
+
+typedef enum {
+    PIPE_PROFILE_L2,
+    PIPE_PROFILE_L3,
+    PIPE_PROFILE_MIXED,
+    PIPE_PROFILE_COUNT
+} pipe_profile_t;
+
+static const char *const g_profile_names[PIPE_PROFILE_COUNT] = { "l2", "l3", "mixed" };
+
+/**
+ * @brief Benchmark settings, from the command line
+ */
+typedef struct {
+    bool profiles[PIPE_PROFILE_COUNT];
+    bool engine;                /* Forwarding engine instead of run to completion */
+    uint32_t workers;
+    uint32_t generators;        /* Engine mode only */
+    uint32_t duration_ms;
+    uint32_t warmup_ms;
+    uint32_t burst;
+    uint32_t frame_size;
+    uint32_t flows;
+    uint32_t routes;
+    uint32_t l3_percent;        /* Routed share of the mixed profile */
+    uint32_t miss_percent;      /* Frames to unknown MACs (flooded) or unrouted prefixes */
+    const char *json;
+} pipe_config_t;
+
+/**
+ * @brief Counters and latency histogram of one thread
+ *
+ * Generators count what they offer, the thread running the forwarding
+ * stage counts what leaves. Only the measurement window is counted.
+ */
+typedef struct __attribute__((aligned(64))) {
+    uint64_t generated;
+    uint64_t rx_refused;        /* Not taken by a full RX ring */
+    uint64_t transmitted;
+    uint64_t latency_sum_ns;
+    uint64_t latency_max_ns;
+    bool counted;               /* Hardware events of the window, rtc mode */
+    perf_sample_t events;
+    uint64_t hist[PIPE_HIST_BUCKETS];
+} pipe_slot_t;
+
+/**
+ * @brief The switch under test and its traffic
+ */
+typedef struct {
+    port_id_t ports[PIPE_MAX_PORTS];    /* Ports whose link came up */
+    uint32_t port_count;
+    mac_addr_t router_mac;
+    uint32_t frame_size;
+    uint32_t flows;
+    uint8_t *l2_frames;                 /* flows frames to known hosts */
+    uint8_t *l3_frames;                 /* flows frames to the router MAC */
+    uint8_t *l2_miss;                   /* Frame to an unknown MAC */
+    uint8_t *l3_miss;                   /* Frame to an unrouted prefix */
+    uint32_t forward_handle;
+} pipe_switch_t;
+
+/**
+ * @brief One measured run
+ */
+typedef struct {
+    pipe_profile_t profile;
+    uint32_t threads;
+    double window_s;
+    uint64_t generated;
+    uint64_t transmitted;
+    uint64_t rx_refused;
+    double offered_mpps;
+    double mpps;
+    double gbps;
+    double latency_mean_ns;
+    uint64_t latency_ns[4];             /* p50, p90, p99, p99.9 */
+    uint64_t latency_max_ns;
+    uint64_t drops[PACKET_DROP_REASON_COUNT];
+    bool has_events;
+    double events[PERF_COUNTER_COUNT];  /* Per forwarded packet */
+    double ipc;
+    const char *bound;
+} pipe_result_t;
+
+static const double g_percentiles[4] = { 0.50, 0.90, 0.99, 0.999 };
+static const char *const g_percentile_names[4] = { "p50", "p90", "p99", "p99_9" };
+
+static pipe_switch_t g_switch;
+static pipe_slot_t g_slots[PIPE_MAX_SLOTS];
+static uint32_t g_slot_count;
+static __thread pipe_slot_t *t_slot;
+static volatile int g_running;
+static volatile int g_measuring;
+
+/**
+ * @brief Counters of the calling thread; the first call takes a slot
+ */
+static pipe_slot_t *pipe_slot(void) {
+    if (!t_slot) {
+        uint32_t index = __atomic_fetch_add(&g_slot_count, 1, __ATOMIC_RELAXED);
+        t_slot = &g_slots[index % PIPE_MAX_SLOTS];
+    }
+    return t_slot;
+}
+
+static inline uint32_t pipe_hist_bucket(uint64_t ns) {
+    if (ns < PIPE_HIST_SUB) {
+        return (uint32_t)ns;
+    }
+    uint32_t msb = 63 - (uint32_t)__builtin_clzll(ns);
+    uint32_t bucket = (msb - 3) * PIPE_HIST_SUB + (uint32_t)((ns >> (msb - 4)) & (PIPE_HIST_SUB - 1));
+    return bucket < PIPE_HIST_BUCKETS ? bucket : PIPE_HIST_BUCKETS - 1;
+}
+
+/* Lower bound of a bucket */
+static inline uint64_t pipe_hist_value(uint32_t bucket) {
+    if (bucket < PIPE_HIST_SUB) {
+        return bucket;
+    }
+    uint32_t msb = bucket / PIPE_HIST_SUB + 3;
+    return (1ULL << msb) | ((uint64_t)(bucket % PIPE_HIST_SUB) << (msb - 4));
+}
+
+static inline void pipe_record_tx(pipe_slot_t *slot, const packet_buffer_t *packet, uint64_t now) {
+    uint64_t latency = now - (uint64_t)(uintptr_t)packet->user_data;
+
+    slot->transmitted++;
+    slot->latency_sum_ns += latency;
+    slot->latency_max_ns = latency > slot->latency_max_ns ? latency : slot->latency_max_ns;
+    slot->hist[pipe_hist_bucket(latency)]++;
+}
+
+/* ----------------------------------------------------------------------------
+ * Forwarding stage
+ * ------------------------------------------------------------------------- */
+
+/**
+ * @brief Route an IPv4 frame sent to the router MAC
+ *
+ * Next hop from the FIB, its MAC from the ARP table; the frame leaves
+ * with new addresses and one hop less.
+ */
+static bool pipe_route(packet_buffer_t *packet, port_id_t *egress) {
+    ipv4_header_t *header;
+    ip_addr_t dst = { .type = IP_TYPE_V4 };
+    ip_addr_t next_hop;
+    uint16_t interface_index;
+    mac_addr_t next_hop_mac;
+    uint16_t port;
+
+    if (!packet_parsed_has(packet, PACKET_PARSED_L3) || packet_has_proto(packet, PACKET_PROTO_IPV6)) {
+        packet_drop_count(packet, PACKET_DROP_IP_HEADER);
+        return false;
+    }
+    header = (ipv4_header_t *)packet_l3_header(packet);
+    if (header->ttl <= 1) {
+        packet_drop_count(packet, PACKET_DROP_TTL_EXCEEDED);
+        return false;
+    }
+
+    dst.addr.v4 = header->dst_addr;
+    if (routing_lookup_nexthop(&dst, IP_TYPE_V4, packet_flow_hash(packet), &next_hop,
+                               &interface_index) != STATUS_SUCCESS) {
+        packet_drop_count(packet, PACKET_DROP_NO_ROUTE);
+        return false;
+    }
+    ipv4_addr_t neighbor = ntohl(next_hop.addr.v4);
+    if (arp_lookup(arp_table_get_instance(), &neighbor, &next_hop_mac, &port) != STATUS_SUCCESS) {
+        packet_drop_count(packet, PACKET_DROP_NEIGHBOR);
+        return false;
+    }
+
+    /* TTL is the high byte of its checksum word, so the checksum grows by 0x0100 */
+    uint32_t sum = ntohs(header->header_checksum) + 0x0100;
+    header->ttl--;
+    header->header_checksum = htons((uint16_t)(sum + (sum >> 16)));
+    memcpy(packet->data, next_hop_mac.addr, 6);
+    memcpy(packet->data + 6, g_switch.router_mac.addr, 6);
+    *egress = (port_id_t)interface_index;
+    return true;
+}
+
+/**
+ * @brief Bridge or route a burst and transmit it on the egress ports
+ *
+ * Frames to unknown MACs are flooded to every other port of the VLAN; the
+ * simulated transmit does not take the buffer, so one buffer serves all
+ * of them.
+ */
+static void pipe_forward_stage(packet_buffer_t **pkts, uint32_t count, packet_result_t *results,
+                               void *user_data) {
+    port_id_t egress[PACKET_BURST_MAX];
+    bool sent[PACKET_BURST_MAX];
+    packet_buffer_t *group[PACKET_BURST_MAX];
+    pipe_slot_t *slot = pipe_slot();
+    (void)user_data;
+
+    for (uint32_t i = 0; i < count; i++) {
+        packet_buffer_t *packet = pkts[i];
+        port_id_t in_port = packet->metadata.port;
+        vlan_id_t vlan_id;
+        mac_addr_t dst;
+
+        results[i] = PACKET_RESULT_DROP;
+        sent[i] = true;
+        if (vlan_process_ingress_inplace(in_port, packet, &vlan_id) != STATUS_SUCCESS) {
+            packet_drop_count(packet, PACKET_DROP_VLAN_FILTER);
+            continue;
+        }
+
+        memcpy(dst.addr, packet->data, 6);
+        if (memcmp(dst.addr, g_switch.router_mac.addr, 6) == 0) {
+            if (!pipe_route(packet, &egress[i])) {
+                continue;
+            }
+        } else if (mac_table_lookup(dst, vlan_id, &egress[i]) != STATUS_SUCCESS) {
+            for (uint32_t p = 0; p < g_switch.port_count; p++) {
+                if (g_switch.ports[p] != in_port) {
+                    hw_sim_transmit_burst(g_switch.ports[p], &packet, 1);
+                }
+            }
+            results[i] = PACKET_RESULT_FORWARD;
+            if (g_measuring) {
+                pipe_record_tx(slot, packet, bench_now_ns());
+            }
+            continue;
+        }
+        results[i] = PACKET_RESULT_FORWARD;
+        sent[i] = false;
+    }
+
+    /* One transmit per egress port of the burst */
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t n = 0;
+
+        if (sent[i]) {
+            continue;
+        }
+        for (uint32_t j = i; j < count; j++) {
+            if (!sent[j] && egress[j] == egress[i]) {
+                group[n++] = pkts[j];
+                sent[j] = true;
+            }
+        }
+
+        hw_sim_transmit_burst(egress[i], group, n);
+        if (g_measuring) {
+            uint64_t now = bench_now_ns();
+            for (uint32_t k = 0; k < n; k++) {
+                if (!group[k]->metadata.is_dropped) {
+                    pipe_record_tx(slot, group[k], now);
+                }
+            }
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Switch and traffic setup
+ * ------------------------------------------------------------------------- */
+
+static mac_addr_t pipe_host_mac(uint32_t host) {
+    mac_addr_t mac = { .addr = { 0x02, 0x00, 0x00, (uint8_t)(host >> 16), (uint8_t)(host >> 8), (uint8_t)host } };
+    return mac;
+}
+
+/* Network of route i, host order: 10.0.0.0/24 upward */
+static inline uint32_t pipe_route_network(uint32_t i) {
+    return ((10U + (i >> 16)) << 24) | ((i & 0xffffU) << 8);
+}
+
+static inline ipv4_addr_t pipe_next_hop(uint32_t k) {
+    return 0xC0A80001U + (k << 8);      /* 192.168.k.1 */
+}
+
+static uint16_t pipe_ipv4_checksum(const uint8_t *header, uint32_t len) {
+    uint32_t sum = 0;
+
+    for (uint32_t i = 0; i + 1 < len; i += 2) {
+        sum += (uint32_t)(header[i] << 8 | header[i + 1]);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+/**
+ * @brief Write an untagged Ethernet/IPv4/UDP frame of the given size
+ */
+static void pipe_build_frame(uint8_t *frame, uint32_t size, const mac_addr_t *dst_mac, uint32_t src_ip,
+                             uint32_t dst_ip, uint16_t src_port) {
+    static const uint8_t src_mac[6] = { 0x02, 0x00, 0x01, 0x00, 0x00, 0x01 };
+    uint8_t *ip = frame + 14;
+    uint8_t *udp = ip + 20;
+    uint16_t ip_len = (uint16_t)(size - 14);
+    uint16_t udp_len = (uint16_t)(ip_len - 20);
+
+    memset(frame, 0, size);
+    memcpy(frame, dst_mac->addr, 6);
+    memcpy(frame + 6, src_mac, 6);
+    frame[12] = ETHERTYPE_IP >> 8;
+    frame[13] = ETHERTYPE_IP & 0xff;
+
+    ip[0] = 0x45;
+    ip[2] = (uint8_t)(ip_len >> 8);
+    ip[3] = (uint8_t)ip_len;
+    ip[8] = 64;
+    ip[9] = IP_PROTO_UDP;
+    for (int b = 0; b < 4; b++) {
+        ip[12 + b] = (uint8_t)(src_ip >> (24 - 8 * b));
+        ip[16 + b] = (uint8_t)(dst_ip >> (24 - 8 * b));
+    }
+    uint16_t csum = pipe_ipv4_checksum(ip, 20);
+    ip[10] = (uint8_t)(csum >> 8);
+    ip[11] = (uint8_t)csum;
+
+    udp[0] = (uint8_t)(src_port >> 8);
+    udp[1] = (uint8_t)src_port;
+    udp[2] = 0x12;
+    udp[3] = 0x34;
+    udp[4] = (uint8_t)(udp_len >> 8);
+    udp[5] = (uint8_t)udp_len;
+}
+
+static status_t pipe_build_traffic(const pipe_config_t *config) {
+    pipe_switch_t *sw = &g_switch;
+    mac_addr_t unknown = pipe_host_mac(0xFFFFFF);
+
+    sw->frame_size = config->frame_size;
+    sw->flows = config->flows;
+    sw->l2_frames = malloc((size_t)sw->flows * sw->frame_size);
+    sw->l3_frames = malloc((size_t)sw->flows * sw->frame_size);
+    sw->l2_miss = malloc(sw->frame_size);
+    sw->l3_miss = malloc(sw->frame_size);
+    if (!sw->l2_frames || !sw->l3_frames || !sw->l2_miss || !sw->l3_miss) {
+        return STATUS_NO_MEMORY;
+    }
+
+    for (uint32_t f = 0; f < sw->flows; f++) {
+        mac_addr_t host = pipe_host_mac(f);
+        uint32_t src_ip = 0xAC100000U | (f & 0xffff);              /* 172.16.0.0/16 */
+        uint32_t dst_ip = pipe_route_network(f % config->routes) | (1 + f % 254);
+
+        pipe_build_frame(sw->l2_frames + (size_t)f * sw->frame_size, sw->frame_size, &host,
+                         src_ip, 0xAC110000U | (f & 0xffff), (uint16_t)(1024 + f));
+        pipe_build_frame(sw->l3_frames + (size_t)f * sw->frame_size, sw->frame_size, &sw->router_mac,
+                         src_ip, dst_ip, (uint16_t)(1024 + f));
+    }
+    pipe_build_frame(sw->l2_miss, sw->frame_size, &unknown, 0xAC100001U, 0xAC110001U, 1024);
+    pipe_build_frame(sw->l3_miss, sw->frame_size, &sw->router_mac, 0xAC100001U, 0x64400001U, 1024);
+    return STATUS_SUCCESS;
+}
+
+static status_t pipe_build_switch(const pipe_config_t *config) {
+    pipe_switch_t *sw = &g_switch;
+    uint32_t port_count = 0;
+    vlan_port_config_t access = {
+        .mode = VLAN_PORT_MODE_ACCESS, .pvid = PIPE_VLAN, .native_vlan = PIPE_VLAN,
+        .accept_untag = true, .accept_tag = false, .ingress_filter = true,
+    };
+    status_t status;
+
+    sw->router_mac = (mac_addr_t){ .addr = { 0x02, 0x00, 0x00, 0xff, 0x00, 0x01 } };
+
+    if ((status = packet_init()) != STATUS_SUCCESS || (status = port_init()) != STATUS_SUCCESS ||
+        (status = hw_sim_get_port_count(&port_count)) != STATUS_SUCCESS ||
+        (status = vlan_init(port_count)) != STATUS_SUCCESS ||
+        (status = mac_table_init(CONFIG_MAX_MAC_TABLE_ENTRIES, 0)) != STATUS_SUCCESS ||
+        (status = arp_init(arp_table_get_instance())) != STATUS_SUCCESS) {
+        fprintf(stderr, "Switch initialization failed: %d\n", status);
+        return status;
+    }
+    if (!routing_table_get_instance()) {
+        fprintf(stderr, "Routing table initialization failed\n");
+        return STATUS_FAILURE;
+    }
+
+    /* The simulated links come up at random; traffic uses the ports that did */
+    if ((status = vlan_create(PIPE_VLAN, "bench")) != STATUS_SUCCESS) {
+        return status;
+    }
+    for (port_id_t p = 0; p < port_count && sw->port_count < PIPE_MAX_PORTS; p++) {
+        port_state_t state;
+        if (hw_sim_get_port_state(p, &state) == STATUS_SUCCESS && state == PORT_STATE_UP) {
+            sw->ports[sw->port_count++] = p;
+            vlan_add_port(PIPE_VLAN, p, VLAN_MEMBER_UNTAGGED);
+            vlan_set_port_config(p, &access);
+        }
+    }
+    if (sw->port_count < 2) {
+        fprintf(stderr, "Only %u simulated ports are up\n", sw->port_count);
+        return STATUS_FAILURE;
+    }
+
+    for (uint32_t f = 0; f < config->flows; f++) {
+        if ((status = mac_table_add(pipe_host_mac(f), sw->ports[f % sw->port_count], PIPE_VLAN, true)) !=
+            STATUS_SUCCESS) {
+            fprintf(stderr, "MAC table took only %u of %u hosts\n", f, config->flows);
+            return status;
+        }
+    }
+
+    for (uint32_t k = 0; k < PIPE_NEXT_HOPS; k++) {
+        ipv4_addr_t next_hop = pipe_next_hop(k);
+        mac_addr_t mac = { .addr = { 0x02, 0x00, 0x02, 0x00, 0x00, (uint8_t)k } };
+        if ((status = arp_add_entry(arp_table_get_instance(), &next_hop, &mac,
+                                    sw->ports[k % sw->port_count])) != STATUS_SUCCESS) {
+            return status;
+        }
+    }
+
+    routing_route_t *routes = calloc(config->routes, sizeof(routing_route_t));
+    uint32_t added = 0;
+    if (!routes) {
+        return STATUS_NO_MEMORY;
+    }
+    for (uint32_t i = 0; i < config->routes; i++) {
+        uint32_t k = i % PIPE_NEXT_HOPS;
+        routes[i].type = IP_TYPE_V4;
+        routes[i].prefix.type = IP_TYPE_V4;
+        routes[i].prefix.addr.v4 = htonl(pipe_route_network(i));
+        routes[i].prefix_len = 24;
+        routes[i].next_hop.type = IP_TYPE_V4;
+        routes[i].next_hop.addr.v4 = htonl(pipe_next_hop(k));
+        routes[i].interface_index = sw->ports[k % sw->port_count];
+        routes[i].source = ROUTE_TYPE_STATIC;
+    }
+    status = routing_table_add_routes(routes, config->routes, &added);
+    free(routes);
+    if (status != STATUS_SUCCESS || added != config->routes) {
+        fprintf(stderr, "Route install failed: %d, %u of %u added\n", status, added, config->routes);
+        return status != STATUS_SUCCESS ? status : STATUS_FAILURE;
+    }
+
+    if ((status = packet_register_burst_processor(pipe_forward_stage, PIPE_FORWARD_PRIORITY, NULL,
+                                                  &sw->forward_handle)) != STATUS_SUCCESS) {
+        return status;
+    }
+    packet_set_processor_name(sw->forward_handle, "bench-forward");
+
+    return pipe_build_traffic(config);
+}
+
+static void pipe_teardown(void) {
+    packet_unregister_processor(g_switch.forward_handle);
+    free(g_switch.l2_frames);
+    free(g_switch.l3_frames);
+    free(g_switch.l2_miss);
+    free(g_switch.l3_miss);
+    routing_table_cleanup();
+    arp_deinit(arp_table_get_instance());
+    mac_table_deinit();
+    vlan_deinit();
+    hw_sim_shutdown();
+    packet_shutdown();
+}
+
+/* ----------------------------------------------------------------------------
+ * Traffic generation
+ * ------------------------------------------------------------------------- */
+
+typedef struct {
+    const pipe_config_t *config;
+    pipe_profile_t profile;
+    port_id_t port;
+    uint32_t index;
+    bool run_to_completion;
+    pthread_t tid;
+} pipe_generator_t;
+
+/**
+ * @brief Pick the template of the next frame
+ */
+static inline const uint8_t *pipe_next_frame(const pipe_generator_t *gen, uint64_t *seed) {
+    const pipe_switch_t *sw = &g_switch;
+    uint64_t r = bench_rand(seed);
+    uint32_t flow = (uint32_t)((r >> 16) % sw->flows);
+    bool routed = gen->profile == PIPE_PROFILE_L3 ||
+                  (gen->profile == PIPE_PROFILE_MIXED && (r & 0xff) * 100 < 256 * gen->config->l3_percent);
+    bool miss = ((r >> 8) & 0xff) * 100 < 256 * gen->config->miss_percent;
+
+    if (miss) {
+        return routed ? sw->l3_miss : sw->l2_miss;
+    }
+    return (routed ? sw->l3_frames : sw->l2_frames) + (size_t)flow * sw->frame_size;
+}
+
+/**
+ * @brief Generate bursts on one ingress port until the run ends
+ *
+ * In run-to-completion mode the generator also processes its port.
+ */
+static void *pipe_generator_main(void *arg) {
+    pipe_generator_t *gen = arg;
+    const pipe_config_t *config = gen->config;
+    packet_buffer_t *burst[PACKET_BURST_MAX];
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (gen->index + 1);
+    pipe_slot_t *slot = pipe_slot();
+    perf_counters_t *pc = gen->run_to_completion ? perf_counters_thread() : NULL;
+    perf_sample_t window_start = { { 0 } };
+    bool counting = false;
+
+    while (__atomic_load_n(&g_running, __ATOMIC_RELAXED)) {
+        uint32_t n = 0;
+
+        /* Counters cover the bursts that start inside the window */
+        if (pc && g_measuring != counting) {
+            perf_sample_t now;
+            if (perf_counters_read(pc, &now) == STATUS_SUCCESS) {
+                if (!counting) {
+                    window_start = now;
+                } else {
+                    perf_sample_delta(&window_start, &now, &slot->events);
+                    slot->counted = true;
+                }
+            }
+            counting = !counting;
+        }
+
+        while (n < config->burst) {
+            packet_buffer_t *packet = packet_buffer_alloc(g_switch.frame_size);
+            if (!packet) {
+                break;
+            }
+            memcpy(packet->data, pipe_next_frame(gen, &seed), g_switch.frame_size);
+            packet->length = g_switch.frame_size;
+            burst[n++] = packet;
+        }
+
+        /* The stamp is taken once per burst, as a NIC writes a burst at once */
+        uint64_t now = bench_now_ns();
+        for (uint32_t i = 0; i < n; i++) {
+            burst[i]->user_data = (void *)(uintptr_t)now;
+        }
+        uint32_t queued = hw_sim_rx_enqueue_burst(gen->port, burst, n);
+        for (uint32_t i = queued; i < n; i++) {
+            packet_buffer_free(burst[i]);
+        }
+        if (g_measuring) {
+            slot->generated += n;
+            slot->rx_refused += n - queued;
+        }
+
+        if (gen->run_to_completion) {
+            hw_sim_rx_poll(gen->port, config->burst);
+        } else if (queued < n) {
+            sched_yield();
+        }
+    }
+
+    /* The run ended before this thread saw the window close */
+    perf_sample_t end;
+    if (counting && perf_counters_read(pc, &end) == STATUS_SUCCESS) {
+        perf_sample_delta(&window_start, &end, &slot->events);
+        slot->counted = true;
+    }
+    if (gen->run_to_completion) {
+        while (hw_sim_rx_poll(gen->port, PACKET_BURST_MAX) > 0) {
+        }
+    }
+    return NULL;
+}
+
+/* ----------------------------------------------------------------------------
+ * Runs and reports
+ * ------------------------------------------------------------------------- */
+
+static void pipe_sleep_ms(uint32_t ms) {
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+/**
+ * @brief Wait until every RX ring is empty, at most timeout_ms
+ */
+static void pipe_wait_drained(uint32_t timeout_ms) {
+    for (uint32_t waited = 0; waited < timeout_ms; waited++) {
+        uint32_t queued = 0;
+        for (uint32_t p = 0; p < g_switch.port_count; p++) {
+            hw_sim_ring_stats_t stats;
+            if (hw_sim_get_ring_stats(g_switch.ports[p], &stats) == STATUS_SUCCESS) {
+                queued += stats.rx_occupancy;
+            }
+        }
+        if (queued == 0) {
+            return;
+        }
+        pipe_sleep_ms(1);
+    }
+}
+
+static void pipe_collect(pipe_result_t *result, const uint64_t drops_before[PACKET_DROP_REASON_COUNT],
+                         uint32_t frame_size) {
+    uint64_t hist[PIPE_HIST_BUCKETS] = { 0 };
+    uint64_t drops_after[PACKET_DROP_REASON_COUNT];
+    uint64_t latency_sum = 0;
+    uint32_t slots = g_slot_count < PIPE_MAX_SLOTS ? g_slot_count : PIPE_MAX_SLOTS;
+    perf_sample_t events = { { 0 } };
+
+    for (uint32_t s = 0; s < slots; s++) {
+        const pipe_slot_t *slot = &g_slots[s];
+        result->generated += slot->generated;
+        result->rx_refused += slot->rx_refused;
+        result->transmitted += slot->transmitted;
+        latency_sum += slot->latency_sum_ns;
+        result->latency_max_ns = slot->latency_max_ns > result->latency_max_ns ?
+                                 slot->latency_max_ns : result->latency_max_ns;
+        for (uint32_t b = 0; b < PIPE_HIST_BUCKETS; b++) {
+            hist[b] += slot->hist[b];
+        }
+        if (slot->counted) {
+            perf_sample_add(&events, &slot->events);
+            result->has_events = true;
+        }
+    }
+
+    result->offered_mpps = (double)result->generated / result->window_s / 1e6;
+    result->mpps = (double)result->transmitted / result->window_s / 1e6;
+    /* On the wire a frame also takes its preamble, FCS and gap: 24 bytes */
+    result->gbps = result->mpps * (frame_size + 24) * 8 / 1e3;
+    result->latency_mean_ns = result->transmitted ? (double)latency_sum / (double)result->transmitted : 0;
+
+    for (uint32_t q = 0; q < 4; q++) {
+        uint64_t rank = (uint64_t)(g_percentiles[q] * (double)result->transmitted);
+        uint64_t seen = 0;
+        for (uint32_t b = 0; b < PIPE_HIST_BUCKETS; b++) {
+            seen += hist[b];
+            if (seen > rank) {
+                result->latency_ns[q] = pipe_hist_value(b);
+                break;
+            }
+        }
+    }
+
+    if (packet_drop_get_counters(drops_after) == STATUS_SUCCESS) {
+        for (uint32_t r = 0; r < PACKET_DROP_REASON_COUNT; r++) {
+            result->drops[r] = drops_after[r] - drops_before[r];
+        }
+    }
+
+    result->has_events = result->has_events && result->transmitted > 0;
+    if (result->has_events) {
+        for (uint32_t e = 0; e < PERF_COUNTER_COUNT; e++) {
+            result->events[e] = (double)events.values[e] / (double)result->transmitted;
+        }
+        result->ipc = perf_sample_ipc(&events);
+        result->bound = perf_sample_bound(&events);
+    }
+}
+
+static status_t pipe_run(const pipe_config_t *config, pipe_profile_t profile, pipe_result_t *result) {
+    pipe_generator_t gens[BENCH_MAX_THREADS];
+    uint32_t count = config->engine ? config->generators : config->workers;
+    uint64_t drops_before[PACKET_DROP_REASON_COUNT] = { 0 };
+    uint64_t start_ns;
+    status_t status;
+
+    if (count > g_switch.port_count) {
+        count = g_switch.port_count;
+    }
+    memset(result, 0, sizeof(*result));
+    /* Threads of the previous run are gone, so their slots are free again */
+    memset(g_slots, 0, sizeof(g_slots));
+    g_slot_count = 0;
+    result->profile = profile;
+    result->threads = config->workers;
+
+    if (config->engine) {
+        forwarding_config_t engine;
+        forwarding_get_default_config(&engine);
+        engine.num_workers = config->workers;
+        engine.burst_size = config->burst;
+        if ((status = forwarding_init(&engine)) != STATUS_SUCCESS) {
+            fprintf(stderr, "forwarding_init failed: %d\n", status);
+            return status;
+        }
+    }
+
+    __atomic_store_n(&g_running, 1, __ATOMIC_RELAXED);
+    for (uint32_t i = 0; i < count; i++) {
+        gens[i] = (pipe_generator_t){
+            .config = config,
+            .profile = profile,
+            .port = g_switch.ports[i],
+            .index = i,
+            .run_to_completion = !config->engine,
+        };
+        pthread_create(&gens[i].tid, NULL, pipe_generator_main, &gens[i]);
+    }
+
+    pipe_sleep_ms(config->warmup_ms);
+    packet_drop_get_counters(drops_before);
+    start_ns = bench_now_ns();
+    __atomic_store_n(&g_measuring, 1, __ATOMIC_RELEASE);
+    pipe_sleep_ms(config->duration_ms);
+    __atomic_store_n(&g_measuring, 0, __ATOMIC_RELEASE);
+    result->window_s = (double)(bench_now_ns() - start_ns) / 1e9;
+
+    __atomic_store_n(&g_running, 0, __ATOMIC_RELAXED);
+    for (uint32_t i = 0; i < count; i++) {
+        pthread_join(gens[i].tid, NULL);
+    }
+    if (config->engine) {
+        pipe_wait_drained(1000);
+        forwarding_shutdown();
+    }
+
+    pipe_collect(result, drops_before, config->frame_size);
+    return STATUS_SUCCESS;
+}
+
+static void pipe_print(const pipe_config_t *config, const pipe_result_t *r) {
+    uint64_t dropped = 0;
+
+    for (uint32_t d = 0; d < PACKET_DROP_REASON_COUNT; d++) {
+        dropped += r->drops[d];
+    }
+    printf("%-6s %-6s %3u %10.3f %10.3f %8.2f %9.0f %9llu %9llu %9llu %10llu %10llu\n",
+           g_profile_names[r->profile], config->engine ? "engine" : "rtc", r->threads,
+           r->offered_mpps, r->mpps, r->gbps, r->latency_mean_ns,
+           (unsigned long long)r->latency_ns[0], (unsigned long long)r->latency_ns[2],
+           (unsigned long long)r->latency_ns[3], (unsigned long long)r->latency_max_ns,
+           (unsigned long long)dropped);
+    if (r->has_events) {
+        printf("       per packet: ipc %.2f, %.0f cycles, %.0f insns, %.2f llc-miss, %.2f br-miss, "
+               "%.2f dtlb-miss, %s-bound\n", r->ipc, r->events[PERF_COUNTER_CYCLES],
+               r->events[PERF_COUNTER_INSTRUCTIONS], r->events[PERF_COUNTER_CACHE_MISSES],
+               r->events[PERF_COUNTER_BRANCH_MISSES], r->events[PERF_COUNTER_DTLB_MISSES], r->bound);
+    }
+    for (uint32_t d = 0; d < PACKET_DROP_REASON_COUNT; d++) {
+        if (r->drops[d]) {
+            printf("       drop %-16s %llu\n", packet_drop_reason_name((packet_drop_reason_t)d),
+                   (unsigned long long)r->drops[d]);
+        }
+    }
+    fflush(stdout);
+}
+
+static int pipe_write_json(const char *path, const pipe_config_t *config, const pipe_result_t *results,
+                           uint32_t count) {
+    FILE *out = fopen(path, "w");
+    char host[256] = "";
+
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    gethostname(host, sizeof(host) - 1);
+
+    fprintf(out, "{\n  \"context\": {\"host\": \"%s\", \"cpus\": %ld, \"date\": %ld, \"mode\": \"%s\", "
+            "\"ports\": %u, \"frame_size\": %u, \"burst\": %u, \"flows\": %u, \"routes\": %u, "
+            "\"duration_ms\": %u},\n  \"results\": [\n",
+            host, sysconf(_SC_NPROCESSORS_ONLN), (long)time(NULL), config->engine ? "engine" : "rtc",
+            g_switch.port_count, config->frame_size, config->burst, config->flows, config->routes,
+            config->duration_ms);
+    for (uint32_t i = 0; i < count; i++) {
+        const pipe_result_t *r = &results[i];
+        bool first = true;
+
+        fprintf(out, "    {\"profile\": \"%s\", \"workers\": %u, \"generated\": %llu, \"transmitted\": %llu, "
+                "\"rx_refused\": %llu, \"offered_mpps\": %.4f, \"mpps\": %.4f, \"gbps\": %.3f, "
+                "\"latency_ns\": {\"mean\": %.1f",
+                g_profile_names[r->profile], r->threads, (unsigned long long)r->generated,
+                (unsigned long long)r->transmitted, (unsigned long long)r->rx_refused,
+                r->offered_mpps, r->mpps, r->gbps, r->latency_mean_ns);
+        for (uint32_t q = 0; q < 4; q++) {
+            fprintf(out, ", \"%s\": %llu", g_percentile_names[q], (unsigned long long)r->latency_ns[q]);
+        }
+        fprintf(out, ", \"max\": %llu}, \"drops\": {", (unsigned long long)r->latency_max_ns);
+        for (uint32_t d = 0; d < PACKET_DROP_REASON_COUNT; d++) {
+            if (r->drops[d]) {
+                fprintf(out, "%s\"%s\": %llu", first ? "" : ", ",
+                        packet_drop_reason_name((packet_drop_reason_t)d), (unsigned long long)r->drops[d]);
+                first = false;
+            }
+        }
+        fprintf(out, "}");
+        if (r->has_events) {
+            fprintf(out, ", \"ipc\": %.3f, \"bound\": \"%s\", \"events_per_packet\": {", r->ipc, r->bound);
+            for (uint32_t e = 0; e < PERF_COUNTER_COUNT; e++) {
+                fprintf(out, "%s\"%s\": %.3f", e ? ", " : "", perf_counter_name((perf_counter_t)e),
+                        r->events[e]);
+            }
+            fprintf(out, "}");
+        }
+        fprintf(out, "}%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+static void pipe_usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--profile=l2|l3|mixed|all] [--mode=rtc|engine] [--workers=N]\n"
+            "          [--generators=N] [--duration-ms=N] [--warmup-ms=N] [--burst=N] [--size=N]\n"
+            "          [--flows=N] [--routes=N] [--l3-percent=N] [--miss-percent=N] [--json=FILE]\n",
+            prog);
+}
+
+static bool pipe_parse_profile(const char *name, pipe_config_t *config) {
+    memset(config->profiles, 0, sizeof(config->profiles));
+    if (strcmp(name, "all") == 0) {
+        for (uint32_t p = 0; p < PIPE_PROFILE_COUNT; p++) {
+            config->profiles[p] = true;
+        }
+        return true;
+    }
+    for (uint32_t p = 0; p < PIPE_PROFILE_COUNT; p++) {
+        if (strcmp(name, g_profile_names[p]) == 0) {
+            config->profiles[p] = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char **argv) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    pipe_config_t config = {
+        .profiles = { true, true, true },
+        .workers = cpus > 0 ? (uint32_t)(cpus < 8 ? cpus : 8) : 1,
+        .duration_ms = 2000,
+        .warmup_ms = 200,
+        .burst = 32,
+        .frame_size = PIPE_MIN_FRAME,
+        .flows = 4096,
+        .routes = 16384,
+        .l3_percent = 50,
+    };
+    pipe_result_t results[PIPE_PROFILE_COUNT];
+    uint32_t result_count = 0;
+    int exit_code = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool ok = true;
+
+        if (strncmp(arg, "--profile=", 10) == 0) {
+            ok = pipe_parse_profile(arg + 10, &config);
+        } else if (strcmp(arg, "--mode=rtc") == 0) {
+            config.engine = false;
+        } else if (strcmp(arg, "--mode=engine") == 0) {
+            config.engine = true;
+        } else if (strncmp(arg, "--workers=", 10) == 0) {
+            config.workers = (uint32_t)strtoul(arg + 10, NULL, 10);
+        } else if (strncmp(arg, "--generators=", 13) == 0) {
+            config.generators = (uint32_t)strtoul(arg + 13, NULL, 10);
+        } else if (strncmp(arg, "--duration-ms=", 14) == 0) {
+            config.duration_ms = (uint32_t)strtoul(arg + 14, NULL, 10);
+        } else if (strncmp(arg, "--warmup-ms=", 12) == 0) {
+            config.warmup_ms = (uint32_t)strtoul(arg + 12, NULL, 10);
+        } else if (strncmp(arg, "--burst=", 8) == 0) {
+            config.burst = (uint32_t)strtoul(arg + 8, NULL, 10);
+        } else if (strncmp(arg, "--size=", 7) == 0) {
+            config.frame_size = (uint32_t)strtoul(arg + 7, NULL, 10);
+        } else if (strncmp(arg, "--flows=", 8) == 0) {
+            config.flows = (uint32_t)strtoul(arg + 8, NULL, 10);
+        } else if (strncmp(arg, "--routes=", 9) == 0) {
+            config.routes = (uint32_t)strtoul(arg + 9, NULL, 10);
+        } else if (strncmp(arg, "--l3-percent=", 13) == 0) {
+            config.l3_percent = (uint32_t)strtoul(arg + 13, NULL, 10);
+        } else if (strncmp(arg, "--miss-percent=", 15) == 0) {
+            config.miss_percent = (uint32_t)strtoul(arg + 15, NULL, 10);
+        } else if (strncmp(arg, "--json=", 7) == 0) {
+            config.json = arg + 7;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            pipe_usage(argv[0]);
+            return 2;
+        }
+    }
+    if (config.generators == 0) {
+        config.generators = config.workers;
+    }
+    if (config.workers == 0 || config.workers > BENCH_MAX_THREADS || config.generators > BENCH_MAX_THREADS ||
+        config.burst == 0 || config.burst > PACKET_BURST_MAX ||
+        config.frame_size < PIPE_MIN_FRAME || config.frame_size > PIPE_MAX_FRAME ||
+        config.flows == 0 || config.flows > PIPE_MAX_FLOWS || config.routes == 0 ||
+        config.l3_percent > 100 || config.miss_percent > 100 || config.duration_ms == 0) {
+        pipe_usage(argv[0]);
+        return 2;
+    }
+
+    bench_init_logging(LOG_LEVEL_ERROR);
+
+    if (pipe_build_switch(&config) != STATUS_SUCCESS) {
+        pipe_teardown();
+        return 1;
+    }
+    if (!config.engine && config.workers > g_switch.port_count) {
+        fprintf(stderr, "Run to completion: %u workers, one per up port\n", g_switch.port_count);
+        config.workers = g_switch.port_count;
+    }
+
+    printf("%-6s %-6s %3s %10s %10s %8s %9s %9s %9s %9s %10s %10s\n", "prof", "mode", "thr",
+           "offer_Mpps", "Mpps", "Gbps", "lat_mean", "lat_p50", "lat_p99", "lat_p999", "lat_max", "drops");
+    for (uint32_t p = 0; p < PIPE_PROFILE_COUNT; p++) {
+        if (!config.profiles[p]) {
+            continue;
+        }
+        if (pipe_run(&config, (pipe_profile_t)p, &results[result_count]) != STATUS_SUCCESS) {
+            exit_code = 1;
+            break;
+        }
+        pipe_print(&config, &results[result_count]);
+        result_count++;
+    }
+
+    if (config.json && pipe_write_json(config.json, &config, results, result_count) != 0) {
+        exit_code = 1;
+    }
+    pipe_teardown();
+    return exit_code;
+}
@@ -0,0 +1,612 @@
+/**
+ * @file bench_scale.c
+ * @brief Table scale harness: degradation curves toward the table limits
+ *
+ * Fills the MAC table, the routing table and the ARP cache in steps of
+ * their configured limits (CONFIG_MAX_MAC_TABLE_ENTRIES,
+ * CONFIG_MAX_ROUTING_ENTRIES, CONFIG_MAX_ARP_ENTRIES), from --step percent
+ * up to 100% and on past the limit to --overflow percent. At every step it
+ * records:
+ *
+ *   insert   ns per entry for the entries added in this step, and how many
+ *            the table refused
+ *   lookup   mean and p99 ns of lookups of random installed keys, the p99
+ *            over batches of SCALE_LOOKUP_BATCH lookups, and the hit ratio
+ *   memory   heap bytes per entry above the empty table
+ *   aging    ns of one aging pass over the table as it is (MAC and ARP;
+ *            the routing table does not age)
+ *
+ * An insert cost that grows with the fill level, rather than staying flat,
+ * points at a linear scan on the insert path. With --max-slowdown=X the
+ * harness exits with status 1 when insert or lookup cost at the limit is
+ * more than X times the cost at the first step, so a build can be gated on
+ * it. --label names the build in the CSV and JSON output, so the curves of
+ * several builds can be laid over each other.
+ *
+ * Usage: switch-scale-bench [--table=mac|route|arp|all] [--step=N] [--overflow=N]
+ *            [--lookups=N] [--label=NAME] [--csv=FILE] [--json=FILE]
+ *            [--max-slowdown=X]
+ */
+
+#include "bench.h"
+
+#include <arpa/inet.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/config.h"
+#include "common/logging.h"
+#include "common/types.h"
+#include "l2/mac_table.h"
+#include "l3/arp.h"
+#include "l3/ip.h"
+#include "l3/routing_table.h"
+
+#define SCALE_VLAN              10
+#define SCALE_PORTS             48
+#define SCALE_LOOKUP_BATCH      16
+#define SCALE_MAX_STEPS         64
+#define SCALE_MAC_AGING_SEC     3600    /* Nothing expires during a run */
+#define SCALE_AGING_TICKS       16      /* MAC aging passes timed per step, one simulated second each */
+
+typedef enum {
+    SCALE_TABLE_MAC = 0,
+    SCALE_TABLE_ROUTE,
+    SCALE_TABLE_ARP,
+    SCALE_TABLE_COUNT
+} scale_table_t;
+
+static const char *const g_table_names[SCALE_TABLE_COUNT] = { "mac", "route", "arp" };
+
+typedef struct {
+    bool tables[SCALE_TABLE_COUNT];
+    uint32_t step_percent;
+    uint32_t overflow_percent;
+    uint32_t lookups;           /* Lookups timed per step */
+    const char *label;
+    const char *csv;
+    const char *json;
+    double max_slowdown;        /* 0: no gate */
+} scale_config_t;
+
+/**
+ * @brief Measurements at one fill level
+ */
+typedef struct {
+    uint32_t percent;
+    uint32_t target;            /* Entries offered so far */
+    uint32_t entries;           /* Entries the table holds */
+    uint32_t refused;           /* Inserts of this step that failed */
+    double insert_ns;           /* Per offered entry of this step */
+    double lookup_ns;
+    double lookup_p99_ns;
+    double hit_ratio;
+    double bytes_per_entry;
+    double aging_ns;            /* Negative when the table does not age */
+} scale_step_t;
+
+typedef struct {
+    scale_table_t table;
+    uint32_t limit;
+    uint32_t step_count;
+    scale_step_t steps[SCALE_MAX_STEPS];
+} scale_curve_t;
+
+/**
+ * @brief One table under test
+ *
+ * insert adds keys [from, to), lookup looks one key up and returns whether
+ * it hit, age runs one aging pass or is NULL.
+ */
+typedef struct {
+    status_t (*setup)(uint32_t limit);
+    void (*teardown)(void);
+    uint32_t (*insert)(uint32_t from, uint32_t to);
+    bool (*lookup)(uint32_t key);
+    void (*age)(void);
+    uint32_t (*count)(void);
+} scale_ops_t;
+
+/* ----------------------------------------------------------------------------
+ * Memory
+ * ------------------------------------------------------------------------- */
+
+/**
+ * @brief Heap bytes in use, resident set size where mallinfo2() is missing
+ */
+static uint64_t scale_memory_bytes(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return (uint64_t)info.uordblks + (uint64_t)info.hblkhd;
+#else
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+
+    if (statm) {
+        if (fscanf(statm, "%lu %lu", &size, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(statm);
+    }
+    return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+/* ----------------------------------------------------------------------------
+ * MAC table
+ * ------------------------------------------------------------------------- */
+
+static uint32_t g_mac_clock;
+
+static mac_addr_t scale_mac(uint32_t i) {
+    mac_addr_t mac = { .addr = { 0x02, 0x00, (uint8_t)(i >> 24), (uint8_t)(i >> 16),
+                                 (uint8_t)(i >> 8), (uint8_t)i } };
+    return mac;
+}
+
+static status_t scale_mac_setup(uint32_t limit) {
+    g_mac_clock = 0;
+    return mac_table_init(limit, SCALE_MAC_AGING_SEC);
+}
+
+static void scale_mac_teardown(void) {
+    mac_table_deinit();
+}
+
+static uint32_t scale_mac_insert(uint32_t from, uint32_t to) {
+    uint32_t refused = 0;
+
+    for (uint32_t i = from; i < to; i++) {
+        if (mac_table_add(scale_mac(i), (port_id_t)(i % SCALE_PORTS + 1), SCALE_VLAN, false) != STATUS_SUCCESS) {
+            refused++;
+        }
+    }
+    return refused;
+}
+
+static bool scale_mac_lookup(uint32_t key) {
+    port_id_t port;
+    return mac_table_lookup(scale_mac(key), SCALE_VLAN, &port) == STATUS_SUCCESS;
+}
+
+static void scale_mac_age(void) {
+    mac_table_process_aging((mac_table_t *)mac_table_get_instance(), ++g_mac_clock);
+}
+
+static uint32_t scale_mac_count(void) {
+    mac_table_stats_t stats;
+    return mac_table_get_stats(&stats) == STATUS_SUCCESS ? stats.total_entries : 0;
+}
+
+/* ----------------------------------------------------------------------------
+ * Routing table
+ * ------------------------------------------------------------------------- */
+
+/* Network of /24 number i, host order: 10.0.0.0/24 upward, then 11.0.0.0 ... */
+static inline uint32_t scale_route_network(uint32_t i) {
+    return ((10U + (i >> 16)) << 24) | ((i & 0xffffU) << 8);
+}
+
+static status_t scale_route_setup(uint32_t limit) {
+    (void)limit;
+    return routing_table_get_instance() ? STATUS_SUCCESS : STATUS_NOT_INITIALIZED;
+}
+
+static void scale_route_teardown(void) {
+    routing_table_cleanup();
+}
+
+/* One route per call, as a routing protocol installs them */
+static uint32_t scale_route_insert(uint32_t from, uint32_t to) {
+    ip_addr_t prefix = { .type = IP_TYPE_V4 };
+    ip_addr_t next_hop = { .type = IP_TYPE_V4 };
+    uint32_t refused = 0;
+
+    for (uint32_t i = from; i < to; i++) {
+        prefix.addr.v4 = htonl(scale_route_network(i));
+        next_hop.addr.v4 = htonl(0xC0A80001U | ((i % 16) << 8));
+        if (routing_add_route(&prefix, 24, IP_TYPE_V4, &next_hop, (uint16_t)(i % SCALE_PORTS + 1), 0,
+                              ROUTE_TYPE_STATIC) != STATUS_SUCCESS) {
+            refused++;
+        }
+    }
+    return refused;
+}
+
+static bool scale_route_lookup(uint32_t key) {
+    ip_addr_t dst = { .type = IP_TYPE_V4 };
+    ip_addr_t next_hop;
+    uint16_t interface_index;
+
+    dst.addr.v4 = htonl(scale_route_network(key) | (key & 0xfe) | 1);
+    return routing_lookup_nexthop(&dst, IP_TYPE_V4, key, &next_hop, &interface_index) == STATUS_SUCCESS;
+}
+
+static uint32_t scale_route_count(void) {
+    routing_table_stats_t stats;
+    return routing_table_get_stats(&stats) == STATUS_SUCCESS ? stats.total_routes : 0;
+}
+
+/* ----------------------------------------------------------------------------
+ * ARP cache
+ * ------------------------------------------------------------------------- */
+
+static inline ipv4_addr_t scale_arp_address(uint32_t i) {
+    return 0x0A800000U + i;     /* 10.128.0.0 upward */
+}
+
+static status_t scale_arp_setup(uint32_t limit) {
+    (void)limit;
+    return arp_init(arp_table_get_instance());
+}
+
+static void scale_arp_teardown(void) {
+    arp_deinit(arp_table_get_instance());
+}
+
+static uint32_t scale_arp_insert(uint32_t from, uint32_t to) {
+    arp_table_t *table = arp_table_get_instance();
+    uint32_t refused = 0;
+
+    for (uint32_t i = from; i < to; i++) {
+        ipv4_addr_t address = scale_arp_address(i);
+        mac_addr_t mac = { .addr = { 0x02, 0x01, 0, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i } };
+        if (arp_add_entry(table, &address, &mac, (uint16_t)(i % SCALE_PORTS + 1)) != STATUS_SUCCESS) {
+            refused++;
+        }
+    }
+    return refused;
+}
+
+static bool scale_arp_lookup(uint32_t key) {
+    ipv4_addr_t address = scale_arp_address(key);
+    mac_addr_t mac;
+    uint16_t port;
+
+    return arp_lookup(arp_table_get_instance(), &address, &mac, &port) == STATUS_SUCCESS;
+}
+
+static void scale_arp_age(void) {
+    arp_age_entries(arp_table_get_instance());
+}
+
+static uint32_t scale_arp_count(void) {
+    arp_stats_t stats;
+    return arp_get_stats(arp_table_get_instance(), &stats) == STATUS_SUCCESS ? (uint32_t)stats.current_entries : 0;
+}
+
+static const scale_ops_t g_table_ops[SCALE_TABLE_COUNT] = {
+    [SCALE_TABLE_MAC] = { scale_mac_setup, scale_mac_teardown, scale_mac_insert, scale_mac_lookup,
+                          scale_mac_age, scale_mac_count },
+    [SCALE_TABLE_ROUTE] = { scale_route_setup, scale_route_teardown, scale_route_insert, scale_route_lookup,
+                            NULL, scale_route_count },
+    [SCALE_TABLE_ARP] = { scale_arp_setup, scale_arp_teardown, scale_arp_insert, scale_arp_lookup,
+                          scale_arp_age, scale_arp_count },
+};
+
+static const uint32_t g_table_limits[SCALE_TABLE_COUNT] = {
+    [SCALE_TABLE_MAC] = CONFIG_MAX_MAC_TABLE_ENTRIES,
+    [SCALE_TABLE_ROUTE] = CONFIG_MAX_ROUTING_ENTRIES,
+    [SCALE_TABLE_ARP] = CONFIG_MAX_ARP_ENTRIES,
+};
+
+/* ----------------------------------------------------------------------------
+ * Curves
+ * ------------------------------------------------------------------------- */
+
+static int scale_compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Time lookups of random keys below target
+ */
+static void scale_measure_lookups(const scale_config_t *config, const scale_ops_t *ops, uint32_t target,
+                                  uint64_t *seed, scale_step_t *step) {
+    uint32_t batches = (config->lookups + SCALE_LOOKUP_BATCH - 1) / SCALE_LOOKUP_BATCH;
+    double *batch_ns = malloc(sizeof(double) * batches);
+    uint32_t keys[SCALE_LOOKUP_BATCH];
+    uint64_t total_ns = 0;
+    uint64_t hits = 0;
+
+    if (!batch_ns || target == 0) {
+        free(batch_ns);
+        return;
+    }
+    for (uint32_t b = 0; b < batches; b++) {
+        for (uint32_t k = 0; k < SCALE_LOOKUP_BATCH; k++) {
+            keys[k] = (uint32_t)(bench_rand(seed) % target);
+        }
+        uint64_t start = bench_now_ns();
+        for (uint32_t k = 0; k < SCALE_LOOKUP_BATCH; k++) {
+            hits += ops->lookup(keys[k]);
+        }
+        uint64_t elapsed = bench_now_ns() - start;
+        total_ns += elapsed;
+        batch_ns[b] = (double)elapsed / SCALE_LOOKUP_BATCH;
+    }
+
+    qsort(batch_ns, batches, sizeof(double), scale_compare_double);
+    step->lookup_ns = (double)total_ns / ((double)batches * SCALE_LOOKUP_BATCH);
+    step->lookup_p99_ns = batch_ns[(uint32_t)((double)(batches - 1) * 0.99)];
+    step->hit_ratio = (double)hits / ((double)batches * SCALE_LOOKUP_BATCH);
+    free(batch_ns);
+}
+
+static status_t scale_run_table(const scale_config_t *config, scale_table_t table, scale_curve_t *curve) {
+    const scale_ops_t *ops = &g_table_ops[table];
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (table + 1);
+    uint64_t base_memory;
+    uint32_t inserted = 0;
+    status_t status;
+
+    memset(curve, 0, sizeof(*curve));
+    curve->table = table;
+    curve->limit = g_table_limits[table];
+
+    base_memory = scale_memory_bytes();
+    if ((status = ops->setup(curve->limit)) != STATUS_SUCCESS) {
+        fprintf(stderr, "%s table setup failed: %d\n", g_table_names[table], status);
+        return status;
+    }
+
+    for (uint32_t percent = config->step_percent;
+         percent <= config->overflow_percent && curve->step_count < SCALE_MAX_STEPS;
+         percent += config->step_percent) {
+        scale_step_t *step = &curve->steps[curve->step_count++];
+        uint32_t target = (uint32_t)((uint64_t)curve->limit * percent / 100);
+
+        step->percent = percent;
+        step->target = target;
+
+        uint64_t start = bench_now_ns();
+        step->refused = ops->insert(inserted, target);
+        uint64_t elapsed = bench_now_ns() - start;
+        step->insert_ns = target > inserted ? (double)elapsed / (double)(target - inserted) : 0;
+        inserted = target;
+
+        step->entries = ops->count();
+        step->bytes_per_entry = step->entries ?
+                                (double)(int64_t)(scale_memory_bytes() - base_memory) / (double)step->entries : 0;
+        scale_measure_lookups(config, ops, target, &seed, step);
+
+        step->aging_ns = -1;
+        if (ops->age) {
+            start = bench_now_ns();
+            for (uint32_t t = 0; t < SCALE_AGING_TICKS; t++) {
+                ops->age();
+            }
+            step->aging_ns = (double)(bench_now_ns() - start) / SCALE_AGING_TICKS;
+        }
+    }
+
+    ops->teardown();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Step reached at the table limit, or the last one below it
+ */
+static const scale_step_t *scale_limit_step(const scale_curve_t *curve) {
+    const scale_step_t *found = NULL;
+
+    for (uint32_t s = 0; s < curve->step_count; s++) {
+        if (curve->steps[s].percent <= 100) {
+            found = &curve->steps[s];
+        }
+    }
+    return found;
+}
+
+static double scale_ratio(double at_limit, double first) {
+    return first > 0 ? at_limit / first : 0;
+}
+
+static void scale_print(const scale_curve_t *curve) {
+    const scale_step_t *first = &curve->steps[0];
+    const scale_step_t *limit = scale_limit_step(curve);
+
+    printf("\n%s table, limit %u entries\n", g_table_names[curve->table], curve->limit);
+    printf("%5s %9s %9s %8s %10s %10s %10s %6s %9s %11s\n", "fill", "offered", "entries", "refused",
+           "insert-ns", "lookup-ns", "p99-ns", "hit%", "bytes/ent", "aging-ns");
+    for (uint32_t s = 0; s < curve->step_count; s++) {
+        const scale_step_t *step = &curve->steps[s];
+        printf("%4u%% %9u %9u %8u %10.1f %10.1f %10.1f %6.1f %9.1f ", step->percent, step->target, step->entries,
+               step->refused, step->insert_ns, step->lookup_ns, step->lookup_p99_ns, step->hit_ratio * 100.0,
+               step->bytes_per_entry);
+        if (step->aging_ns >= 0) {
+            printf("%11.0f\n", step->aging_ns);
+        } else {
+            printf("%11s\n", "-");
+        }
+    }
+    if (curve->step_count > 0 && limit) {
+        printf("%u%% -> %u%%: insert x%.2f, lookup x%.2f\n", first->percent, limit->percent,
+               scale_ratio(limit->insert_ns, first->insert_ns), scale_ratio(limit->lookup_ns, first->lookup_ns));
+    }
+    fflush(stdout);
+}
+
+static int scale_write_csv(const char *path, const scale_config_t *config, const scale_curve_t *curves,
+                           uint32_t count) {
+    FILE *out = fopen(path, "w");
+
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    fprintf(out, "label,table,limit,percent,offered,entries,refused,insert_ns,lookup_ns,lookup_p99_ns,"
+            "hit_ratio,bytes_per_entry,aging_ns\n");
+    for (uint32_t c = 0; c < count; c++) {
+        for (uint32_t s = 0; s < curves[c].step_count; s++) {
+            const scale_step_t *step = &curves[c].steps[s];
+            fprintf(out, "%s,%s,%u,%u,%u,%u,%u,%.2f,%.2f,%.2f,%.4f,%.2f,", config->label,
+                    g_table_names[curves[c].table], curves[c].limit, step->percent, step->target, step->entries,
+                    step->refused, step->insert_ns, step->lookup_ns, step->lookup_p99_ns, step->hit_ratio,
+                    step->bytes_per_entry);
+            if (step->aging_ns >= 0) {
+                fprintf(out, "%.1f", step->aging_ns);
+            }
+            fprintf(out, "\n");
+        }
+    }
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+static int scale_write_json(const char *path, const scale_config_t *config, const scale_curve_t *curves,
+                            uint32_t count) {
+    FILE *out = fopen(path, "w");
+    char host[256] = "";
+
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    gethostname(host, sizeof(host) - 1);
+
+    fprintf(out, "{\n  \"context\": {\"label\": \"%s\", \"host\": \"%s\", \"date\": %ld, \"compiler\": \"%s\", "
+            "\"lookups\": %u},\n  \"tables\": [\n",
+            config->label, host, (long)time(NULL), __VERSION__, config->lookups);
+    for (uint32_t c = 0; c < count; c++) {
+        fprintf(out, "    {\"table\": \"%s\", \"limit\": %u, \"steps\": [\n", g_table_names[curves[c].table],
+                curves[c].limit);
+        for (uint32_t s = 0; s < curves[c].step_count; s++) {
+            const scale_step_t *step = &curves[c].steps[s];
+            fprintf(out, "      {\"percent\": %u, \"offered\": %u, \"entries\": %u, \"refused\": %u, "
+                    "\"insert_ns\": %.2f, \"lookup_ns\": %.2f, \"lookup_p99_ns\": %.2f, \"hit_ratio\": %.4f, "
+                    "\"bytes_per_entry\": %.2f",
+                    step->percent, step->target, step->entries, step->refused, step->insert_ns, step->lookup_ns,
+                    step->lookup_p99_ns, step->hit_ratio, step->bytes_per_entry);
+            if (step->aging_ns >= 0) {
+                fprintf(out, ", \"aging_ns\": %.1f", step->aging_ns);
+            }
+            fprintf(out, "}%s\n", s + 1 < curves[c].step_count ? "," : "");
+        }
+        fprintf(out, "    ]}%s\n", c + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Tables whose cost at the limit grew past the allowed slowdown
+ */
+static uint32_t scale_check(const scale_config_t *config, const scale_curve_t *curves, uint32_t count) {
+    uint32_t failed = 0;
+
+    for (uint32_t c = 0; config->max_slowdown > 0 && c < count; c++) {
+        const scale_step_t *first = &curves[c].steps[0];
+        const scale_step_t *limit = scale_limit_step(&curves[c]);
+        double insert;
+        double lookup;
+
+        if (curves[c].step_count == 0 || !limit) {
+            continue;
+        }
+        insert = scale_ratio(limit->insert_ns, first->insert_ns);
+        lookup = scale_ratio(limit->lookup_ns, first->lookup_ns);
+        if (insert > config->max_slowdown || lookup > config->max_slowdown) {
+            fprintf(stderr, "%s table: insert x%.2f, lookup x%.2f at the limit, allowed x%.2f\n",
+                    g_table_names[curves[c].table], insert, lookup, config->max_slowdown);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+static void scale_usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--table=mac|route|arp|all] [--step=N] [--overflow=N] [--lookups=N]\n"
+            "          [--label=NAME] [--csv=FILE] [--json=FILE] [--max-slowdown=X]\n", prog);
+}
+
+static bool scale_parse_table(const char *name, scale_config_t *config) {
+    memset(config->tables, 0, sizeof(config->tables));
+    if (strcmp(name, "all") == 0) {
+        for (uint32_t t = 0; t < SCALE_TABLE_COUNT; t++) {
+            config->tables[t] = true;
+        }
+        return true;
+    }
+    for (uint32_t t = 0; t < SCALE_TABLE_COUNT; t++) {
+        if (strcmp(name, g_table_names[t]) == 0) {
+            config->tables[t] = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char **argv) {
+    scale_config_t config = {
+        .tables = { true, true, true },
+        .step_percent = 10,
+        .overflow_percent = 120,
+        .lookups = 65536,
+        .label = "default",
+    };
+    static scale_curve_t curves[SCALE_TABLE_COUNT];
+    uint32_t count = 0;
+    int rc = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool ok = true;
+
+        if (strncmp(arg, "--table=", 8) == 0) {
+            ok = scale_parse_table(arg + 8, &config);
+        } else if (strncmp(arg, "--step=", 7) == 0) {
+            config.step_percent = (uint32_t)strtoul(arg + 7, NULL, 10);
+            ok = config.step_percent > 0 && config.step_percent <= 100;
+        } else if (strncmp(arg, "--overflow=", 11) == 0) {
+            config.overflow_percent = (uint32_t)strtoul(arg + 11, NULL, 10);
+            ok = config.overflow_percent >= 100;
+        } else if (strncmp(arg, "--lookups=", 10) == 0) {
+            config.lookups = (uint32_t)strtoul(arg + 10, NULL, 10);
+            ok = config.lookups > 0;
+        } else if (strncmp(arg, "--label=", 8) == 0) {
+            config.label = arg + 8;
+        } else if (strncmp(arg, "--csv=", 6) == 0) {
+            config.csv = arg + 6;
+        } else if (strncmp(arg, "--json=", 7) == 0) {
+            config.json = arg + 7;
+        } else if (strncmp(arg, "--max-slowdown=", 15) == 0) {
+            config.max_slowdown = strtod(arg + 15, NULL);
+            ok = config.max_slowdown > 0;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            scale_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    /* Past the limit every refused insert logs an error, which would be timed along with it */
+    bench_init_logging(LOG_LEVEL_FATAL);
+
+    for (uint32_t t = 0; t < SCALE_TABLE_COUNT; t++) {
+        if (config.tables[t] && scale_run_table(&config, (scale_table_t)t, &curves[count]) == STATUS_SUCCESS) {
+            scale_print(&curves[count]);
+            count++;
+        }
+    }
+
+    if (config.csv && scale_write_csv(config.csv, &config, curves, count) != 0) {
+        rc = 1;
+    }
+    if (config.json && scale_write_json(config.json, &config, curves, count) != 0) {
+        rc = 1;
+    }
+    if (scale_check(&config, curves, count) > 0) {
+        rc = 1;
+    }
+    return rc;
+}
@@ -68,12 +68,45 @@ typedef enum {
 // 5. Resource types (for bsp_allocate_resource/bsp_free_resource)
 // -----------------------------------------------------------------------------
 typedef enum {
-   BSP_RESOURCE_TYPE_BUFFER,
-   BSP_RESOURCE_TYPE_DESCRIPTOR,
-   BSP_RESOURCE_TYPE_QUEUE,
-   BSP_RESOURCE_TYPE_QOS_SCHEDULER
+   BSP_RESOURCE_TYPE_BUFFER,          // packet buffer memory, in cells
+   BSP_RESOURCE_TYPE_DESCRIPTOR,      // DMA descriptors
+   BSP_RESOURCE_TYPE_QUEUE,           // egress queues
+   BSP_RESOURCE_TYPE_QOS_SCHEDULER,   // scheduler nodes
+   BSP_RESOURCE_TYPE_TCAM_SLICE,      // ACL TCAM slices
+   BSP_RESOURCE_TYPE_COUNTER_BANK,    // statistics counter banks
+   BSP_RESOURCE_TYPE_COUNT            // number of resource types
 } bsp_resource_type_t;
 
+/**
+* @brief Pool of one resource type on the board
+*
+* Every unit of a pool is the same size: an allocation takes exactly one
+* unit, and units with memory behind them (unit_size > 0) hand it out
+* through bsp_resource_data().
+*/
+typedef struct {
+   uint32_t count;                 // units on the board, 0 if the board has none
+   uint32_t unit_size;             // bytes of memory per unit, 0 for none
+   uint32_t entries;               // table entries per unit (TCAM rows, counters), 0 if not a table
+} bsp_resource_pool_profile_t;
+
+/**
+* @brief Occupancy of one resource pool, from bsp_get_resource_usage()
+*/
+typedef struct {
+   uint32_t total;                 // units in the pool
+   uint32_t used;                  // units allocated
+   uint32_t peak;                  // most units ever allocated at once
+   uint64_t failures;              // allocations refused because the pool was empty
+   uint32_t unit_size;             // bytes of memory per unit
+   uint32_t entries;               // table entries per unit
+} bsp_resource_usage_t;
+
+#define BSP_MAX_RESOURCE_UNITS  (1u << 20)  // most units in one pool
+#define BSP_BUFFER_CELL_SIZE    16384       // bytes of a packet buffer cell
+#define BSP_BUFFER_CELLS_PER_MB (1024u * 1024u / BSP_BUFFER_CELL_SIZE)
+#define BSP_DESCRIPTOR_SIZE     32          // bytes of a DMA descriptor
+
 // -----------------------------------------------------------------------------
 // 6. Board types and port speed/duplex/type definitions
 // -----------------------------------------------------------------------------
@@ -134,6 +167,22 @@ typedef struct {
    uint32_t        default_queue_id;
 } bsp_qos_config_t;
 
+// -----------------------------------------------------------------------------
+// 7a. MAC table hardware layout (hash banks of the modeled ASIC)
+// -----------------------------------------------------------------------------
+typedef enum {
+   BSP_MAC_TABLE_MODE_CUCKOO,      // simulator table, no bank emulation
+   BSP_MAC_TABLE_MODE_BANKED       // emulate d-left hash banks with overflow
+} bsp_mac_table_mode_t;
+
+typedef struct {
+   bsp_mac_table_mode_t mode;      // placement mode
+   uint32_t banks;                 // hash banks
+   uint32_t rows_per_bank;         // rows in each bank
+   uint32_t ways;                  // entries per row
+   uint32_t overflow_per_bank;     // overflow (CAM) entries per bank
+} bsp_mac_table_profile_t;
+
 // -----------------------------------------------------------------------------
 // 8. Port status and board configuration structures
 // -----------------------------------------------------------------------------
@@ -168,6 +217,8 @@ typedef struct {
    bool             has_sai_support;   // SAI compatibility
    char             board_name[BSP_MAX_BOARD_NAME_LEN]; // board name with size limit
    char             firmware_version[32]; // firmware version string
+   bsp_mac_table_profile_t mac_table;  // MAC table hash layout to emulate
+   bsp_resource_pool_profile_t resources[BSP_RESOURCE_TYPE_COUNT]; // resource pools, by type
 } bsp_config_t;
 
 /**
@@ -396,12 +447,17 @@ bsp_error_t bsp_port_register_callback(uint32_t port_id,
 bsp_error_t bsp_port_unregister_callback(uint32_t port_id);
 
 /**
-* @brief Allocate a generic resource (e.g., buffer, descriptor) in BSP
+* @brief Allocate one unit of a resource pool (e.g., buffer cell, TCAM slice)
+*
+* Pools are sized by the board's resource profile when the BSP is
+* initialized. Allocation and free are O(1): units come off and go back
+* on a free list.
 *
 * @param[in]  resource_type Resource type (enum bsp_resource_type_t)
-* @param[in]  size          Size in bytes
+* @param[in]  size          Bytes needed, at most the pool's unit size; 0 for any
 * @param[out] handle        Output handle (opaque pointer)
-* @return BSP_SUCCESS or error code (e.g., BSP_ERROR_RESOURCE_UNAVAILABLE)
+* @return BSP_SUCCESS or error code (BSP_ERROR_RESOURCE_UNAVAILABLE when
+*         the pool is empty, BSP_ERROR_INVALID_PARAM when size does not fit a unit)
 */
 bsp_error_t bsp_allocate_resource(bsp_resource_type_t resource_type, uint32_t size, bsp_resource_handle_t* handle);
 
@@ -409,10 +465,28 @@ bsp_error_t bsp_allocate_resource(bsp_resource_type_t resource_type, uint32_t si
 * @brief Free previously allocated resource
 *
 * @param[in] handle Handle obtained from bsp_allocate_resource()
-* @return BSP_SUCCESS or error code
+* @return BSP_SUCCESS or error code (BSP_ERROR_INVALID_PARAM for a handle
+*         that is not allocated)
 */
 bsp_error_t bsp_free_resource(bsp_resource_handle_t handle);
 
+/**
+* @brief Get the memory behind an allocated unit
+*
+* @param[in] handle Handle obtained from bsp_allocate_resource()
+* @return unit_size bytes, zeroed at allocation; NULL for pools without memory
+*/
+void* bsp_resource_data(bsp_resource_handle_t handle);
+
+/**
+* @brief Get the occupancy of a resource pool
+*
+* @param[in]  resource_type Resource type
+* @param[out] usage         Pool occupancy
+* @return BSP_SUCCESS or error code
+*/
+bsp_error_t bsp_get_resource_usage(bsp_resource_type_t resource_type, bsp_resource_usage_t* usage);
+
 /**
 * @brief Get current timestamp in microseconds
 *
@@ -23,7 +23,16 @@ static const bsp_config_t default_configs[] = {
         .has_vxlan_support = false,
         .has_sai_support = true,
         .board_name = "Generic Switch",
-        .firmware_version = BSP_VERSION_STRING
+        .firmware_version = BSP_VERSION_STRING,
+        .mac_table = { .mode = BSP_MAC_TABLE_MODE_CUCKOO },
+        .resources = {
+            [BSP_RESOURCE_TYPE_BUFFER]        = { .count = 32 * BSP_BUFFER_CELLS_PER_MB, .unit_size = BSP_BUFFER_CELL_SIZE },
+            [BSP_RESOURCE_TYPE_DESCRIPTOR]    = { .count = 2048, .unit_size = BSP_DESCRIPTOR_SIZE },
+            [BSP_RESOURCE_TYPE_QUEUE]         = { .count = 8 * BSP_MAX_QOS_QUEUES },
+            [BSP_RESOURCE_TYPE_QOS_SCHEDULER] = { .count = 8 * 2 },
+            [BSP_RESOURCE_TYPE_TCAM_SLICE]    = { .count = 4, .entries = 256 },
+            [BSP_RESOURCE_TYPE_COUNTER_BANK]  = { .count = 8, .entries = 256 }
+        }
     },
     // Small board
     {
@@ -38,7 +47,15 @@ static const bsp_config_t default_configs[] = {
         .has_vxlan_support = false,
         .has_sai_support = true,
         .board_name = "Small Switch",
-        .firmware_version = BSP_VERSION_STRING
+        .firmware_version = BSP_VERSION_STRING,
+        .mac_table = { .mode = BSP_MAC_TABLE_MODE_CUCKOO },
+        .resources = {
+            [BSP_RESOURCE_TYPE_BUFFER]        = { .count = 16 * BSP_BUFFER_CELLS_PER_MB, .unit_size = BSP_BUFFER_CELL_SIZE },
+            [BSP_RESOURCE_TYPE_DESCRIPTOR]    = { .count = 1024, .unit_size = BSP_DESCRIPTOR_SIZE },
+            [BSP_RESOURCE_TYPE_QUEUE]         = { .count = 8 * BSP_MAX_QOS_QUEUES },
+            [BSP_RESOURCE_TYPE_QOS_SCHEDULER] = { .count = 8 * 2 },
+            [BSP_RESOURCE_TYPE_COUNTER_BANK]  = { .count = 4, .entries = 256 }
+        }
     },
     // Medium board
     {
@@ -53,7 +70,22 @@ static const bsp_config_t default_configs[] = {
         .has_vxlan_support = true,
         .has_sai_support = true,
         .board_name = "Medium Switch",
-        .firmware_version = BSP_VERSION_STRING
+        .firmware_version = BSP_VERSION_STRING,
+        .mac_table = {
+            .mode = BSP_MAC_TABLE_MODE_BANKED,
+            .banks = 4,
+            .rows_per_bank = 512,
+            .ways = 4,
+            .overflow_per_bank = 16
+        },
+        .resources = {
+            [BSP_RESOURCE_TYPE_BUFFER]        = { .count = 64 * BSP_BUFFER_CELLS_PER_MB, .unit_size = BSP_BUFFER_CELL_SIZE },
+            [BSP_RESOURCE_TYPE_DESCRIPTOR]    = { .count = 4096, .unit_size = BSP_DESCRIPTOR_SIZE },
+            [BSP_RESOURCE_TYPE_QUEUE]         = { .count = 24 * BSP_MAX_QOS_QUEUES },
+            [BSP_RESOURCE_TYPE_QOS_SCHEDULER] = { .count = 24 * 2 },
+            [BSP_RESOURCE_TYPE_TCAM_SLICE]    = { .count = 8, .entries = 256 },
+            [BSP_RESOURCE_TYPE_COUNTER_BANK]  = { .count = 16, .entries = 256 }
+        }
     },
     // Large board
     {
@@ -68,7 +100,22 @@ static const bsp_config_t default_configs[] = {
         .has_vxlan_support = true,
         .has_sai_support = true,
         .board_name = "Large Switch",
-        .firmware_version = BSP_VERSION_STRING
+        .firmware_version = BSP_VERSION_STRING,
+        .mac_table = {
+            .mode = BSP_MAC_TABLE_MODE_BANKED,
+            .banks = 4,
+            .rows_per_bank = 1024,
+            .ways = 4,
+            .overflow_per_bank = 32
+        },
+        .resources = {
+            [BSP_RESOURCE_TYPE_BUFFER]        = { .count = 128 * BSP_BUFFER_CELLS_PER_MB, .unit_size = BSP_BUFFER_CELL_SIZE },
+            [BSP_RESOURCE_TYPE_DESCRIPTOR]    = { .count = 8192, .unit_size = BSP_DESCRIPTOR_SIZE },
+            [BSP_RESOURCE_TYPE_QUEUE]         = { .count = 48 * BSP_MAX_QOS_QUEUES },
+            [BSP_RESOURCE_TYPE_QOS_SCHEDULER] = { .count = 48 * 2 },
+            [BSP_RESOURCE_TYPE_TCAM_SLICE]    = { .count = 12, .entries = 512 },
+            [BSP_RESOURCE_TYPE_COUNTER_BANK]  = { .count = 32, .entries = 256 }
+        }
     },
     // Datacenter board
     {
@@ -83,7 +130,22 @@ static const bsp_config_t default_configs[] = {
         .has_vxlan_support = true,
         .has_sai_support = true,
         .board_name = "Datacenter Switch",
-        .firmware_version = BSP_VERSION_STRING
+        .firmware_version = BSP_VERSION_STRING,
+        .mac_table = {
+            .mode = BSP_MAC_TABLE_MODE_BANKED,
+            .banks = 4,
+            .rows_per_bank = 4080,
+            .ways = 4,
+            .overflow_per_bank = 64
+        },
+        .resources = {
+            [BSP_RESOURCE_TYPE_BUFFER]        = { .count = 512 * BSP_BUFFER_CELLS_PER_MB, .unit_size = BSP_BUFFER_CELL_SIZE },
+            [BSP_RESOURCE_TYPE_DESCRIPTOR]    = { .count = 32768, .unit_size = BSP_DESCRIPTOR_SIZE },
+            [BSP_RESOURCE_TYPE_QUEUE]         = { .count = 64 * BSP_MAX_QOS_QUEUES },
+            [BSP_RESOURCE_TYPE_QOS_SCHEDULER] = { .count = 64 * 2 },
+            [BSP_RESOURCE_TYPE_TCAM_SLICE]    = { .count = 16, .entries = 512 },
+            [BSP_RESOURCE_TYPE_COUNTER_BANK]  = { .count = 64, .entries = 256 }
+        }
     },
     // Enterprise board (новый тип)
     {
@@ -98,7 +160,22 @@ static const bsp_config_t default_configs[] = {
         .has_vxlan_support = true,
         .has_sai_support = true,
         .board_name = "Enterprise Switch",
-        .firmware_version = BSP_VERSION_STRING
+        .firmware_version = BSP_VERSION_STRING,
+        .mac_table = {
+            .mode = BSP_MAC_TABLE_MODE_BANKED,
+            .banks = 2,
+            .rows_per_bank = 4096,
+            .ways = 4,
+            .overflow_per_bank = 32
+        },
+        .resources = {
+            [BSP_RESOURCE_TYPE_BUFFER]        = { .count = 256 * BSP_BUFFER_CELLS_PER_MB, .unit_size = BSP_BUFFER_CELL_SIZE },
+            [BSP_RESOURCE_TYPE_DESCRIPTOR]    = { .count = 16384, .unit_size = BSP_DESCRIPTOR_SIZE },
+            [BSP_RESOURCE_TYPE_QUEUE]         = { .count = 32 * BSP_MAX_QOS_QUEUES },
+            [BSP_RESOURCE_TYPE_QOS_SCHEDULER] = { .count = 32 * 2 },
+            [BSP_RESOURCE_TYPE_TCAM_SLICE]    = { .count = 12, .entries = 512 },
+            [BSP_RESOURCE_TYPE_COUNTER_BANK]  = { .count = 32, .entries = 256 }
+        }
     }
 };
 
@@ -148,6 +225,19 @@ static bsp_error_t validate_config(const bsp_config_t* config) {
     if (config->packet_buffer_mb == 0) {
         return BSP_ERROR_INVALID_PARAM;
     }
+
+    // Resource pools must fit the board: buffer cells in the packet buffer
+    for (uint32_t type = 0; type < BSP_RESOURCE_TYPE_COUNT; type++) {
+        if (config->resources[type].count > BSP_MAX_RESOURCE_UNITS ||
+            config->resources[type].unit_size > BSP_BUFFER_CELL_SIZE) {
+            return BSP_ERROR_INVALID_PARAM;
+        }
+    }
+    if ((uint64_t)config->resources[BSP_RESOURCE_TYPE_BUFFER].count *
+        config->resources[BSP_RESOURCE_TYPE_BUFFER].unit_size >
+        (uint64_t)config->packet_buffer_mb * 1024 * 1024) {
+        return BSP_ERROR_INVALID_PARAM;
+    }
     
     return BSP_SUCCESS;
 }
@@ -9,23 +9,31 @@
 #include <stdio.h>
 #include <time.h>
 
-// Resource type definitions
-#define RESOURCE_TYPE_MEMORY   1
-#define RESOURCE_TYPE_PORT     2
-#define RESOURCE_TYPE_TIMER    3
-#define RESOURCE_TYPE_QUEUE    4
-
-// Structure for tracking allocated resources
-typedef struct resource_entry {
-    bsp_resource_handle_t handle;
-    uint32_t resource_type;
-    uint32_t size;
-    void* data;
-    struct resource_entry* next;
-} resource_entry_t;
-
-// List head for resource tracking
-static resource_entry_t* resource_list = NULL;
+// End of a resource free list
+#define RESOURCE_NONE UINT32_MAX
+
+// One unit of a resource pool; handles point at these
+typedef struct resource_unit {
+    uint32_t next_free;     // next unit on the free list
+    uint16_t type;          // bsp_resource_type_t of the pool
+    bool in_use;
+} resource_unit_t;
+
+// Fixed pool of one resource type, sized by the board profile
+typedef struct {
+    resource_unit_t* units; // count units
+    uint8_t* memory;        // count * unit_size bytes, NULL if unit_size is 0
+    uint32_t count;
+    uint32_t unit_size;
+    uint32_t entries;
+    uint32_t free_head;     // first free unit, RESOURCE_NONE if the pool is empty
+    uint32_t used;
+    uint32_t peak;
+    uint64_t failures;
+} resource_pool_t;
+
+static resource_pool_t resource_pools[BSP_RESOURCE_TYPE_COUNT];
+static pthread_mutex_t resource_lock = PTHREAD_MUTEX_INITIALIZER;
 
 // Port callback structure
 typedef struct port_callback {
@@ -59,59 +67,126 @@ bsp_error_t bsp_register_driver(const char* driver_name, void* driver_init_func)
 }
 
 /**
- * @brief Allocate a hardware resource
+ * @brief Free every resource pool
  */
-bsp_error_t bsp_allocate_resource(uint32_t resource_type, uint32_t size, bsp_resource_handle_t* handle) {
-    if (handle == NULL) {
+static void bsp_resource_pools_free(void) {
+    for (uint32_t type = 0; type < BSP_RESOURCE_TYPE_COUNT; type++) {
+        free(resource_pools[type].units);
+        free(resource_pools[type].memory);
+    }
+    memset(resource_pools, 0, sizeof(resource_pools));
+}
+
+/**
+ * @brief Build the resource pools of a board profile, every unit free
+ */
+bsp_error_t bsp_resource_pools_init(const bsp_config_t* config) {
+    if (config == NULL) {
+        return BSP_ERROR_INVALID_PARAM;
+    }
+
+    pthread_mutex_lock(&resource_lock);
+    bsp_resource_pools_free();
+    for (uint32_t type = 0; type < BSP_RESOURCE_TYPE_COUNT; type++) {
+        const bsp_resource_pool_profile_t* profile = &config->resources[type];
+        resource_pool_t* pool = &resource_pools[type];
+
+        pool->free_head = RESOURCE_NONE;
+        if (profile->count == 0) {
+            continue;
+        }
+        pool->units = (resource_unit_t*)malloc(profile->count * sizeof(resource_unit_t));
+        // Zero pages from calloc: memory of units never allocated is never touched
+        pool->memory = profile->unit_size ?
+            (uint8_t*)calloc(profile->count, profile->unit_size) : NULL;
+        if (pool->units == NULL || (profile->unit_size && pool->memory == NULL)) {
+            bsp_resource_pools_free();
+            pthread_mutex_unlock(&resource_lock);
+            return BSP_ERROR_RESOURCE_UNAVAILABLE;
+        }
+
+        pool->count = profile->count;
+        pool->unit_size = profile->unit_size;
+        pool->entries = profile->entries;
+        for (uint32_t i = 0; i < pool->count; i++) {
+            pool->units[i].next_free = i + 1 < pool->count ? i + 1 : RESOURCE_NONE;
+            pool->units[i].type = (uint16_t)type;
+            pool->units[i].in_use = false;
+        }
+        pool->free_head = 0;
+    }
+    pthread_mutex_unlock(&resource_lock);
+
+    return BSP_SUCCESS;
+}
+
+/**
+ * @brief Pool unit of a handle, NULL if the handle is not a unit
+ *
+ * Called with the resource lock held.
+ */
+static resource_unit_t* bsp_resource_unit(bsp_resource_handle_t handle, resource_pool_t** pool_out) {
+    const resource_unit_t* unit = (const resource_unit_t*)handle;
+
+    // One range check per type, whatever the pool sizes
+    for (uint32_t type = 0; type < BSP_RESOURCE_TYPE_COUNT; type++) {
+        resource_pool_t* pool = &resource_pools[type];
+        if (pool->count && unit >= pool->units && unit < pool->units + pool->count) {
+            *pool_out = pool;
+            return &pool->units[unit - pool->units];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Allocate one unit of a resource pool
+ */
+bsp_error_t bsp_allocate_resource(bsp_resource_type_t resource_type, uint32_t size, bsp_resource_handle_t* handle) {
+    if (handle == NULL || (uint32_t)resource_type >= BSP_RESOURCE_TYPE_COUNT) {
         return BSP_ERROR_INVALID_PARAM;
     }
     
     if (!bsp_is_initialized()) {
         return BSP_ERROR_NOT_INITIALIZED;
     }
-    
-    // Validate resource type
-    if (resource_type != RESOURCE_TYPE_MEMORY && 
-        resource_type != RESOURCE_TYPE_PORT &&
-        resource_type != RESOURCE_TYPE_TIMER &&
-        resource_type != RESOURCE_TYPE_QUEUE) {
+
+    pthread_mutex_lock(&resource_lock);
+    resource_pool_t* pool = &resource_pools[resource_type];
+    // Units without memory take any size; the others must hold it
+    if (pool->unit_size != 0 && size > pool->unit_size) {
+        pthread_mutex_unlock(&resource_lock);
         return BSP_ERROR_INVALID_PARAM;
     }
-    
-    // Allocate the resource entry
-    resource_entry_t* entry = (resource_entry_t*)malloc(sizeof(resource_entry_t));
-    if (entry == NULL) {
+    if (pool->free_head == RESOURCE_NONE) {
+        pool->failures++;
+        pthread_mutex_unlock(&resource_lock);
         return BSP_ERROR_RESOURCE_UNAVAILABLE;
     }
-    
-    // Allocate the resource data
-    entry->data = malloc(size);
-    if (entry->data == NULL) {
-        free(entry);
-        return BSP_ERROR_RESOURCE_UNAVAILABLE;
+
+    uint32_t index = pool->free_head;
+    resource_unit_t* unit = &pool->units[index];
+    pool->free_head = unit->next_free;
+    unit->next_free = RESOURCE_NONE;
+    unit->in_use = true;
+    if (++pool->used > pool->peak) {
+        pool->peak = pool->used;
     }
-    
-    // Initialize the resource
-    memset(entry->data, 0, size);
-    entry->handle = entry->data; // Use the data pointer as the handle
-    entry->resource_type = resource_type;
-    entry->size = size;
-    
-    // Add to the resource list
-    entry->next = resource_list;
-    resource_list = entry;
-    
-    *handle = entry->handle;
-    
-    printf("BSP: Allocated resource type %u, size %u\n", resource_type, size);
-    
+    if (pool->memory != NULL) {
+        memset(pool->memory + (size_t)index * pool->unit_size, 0, pool->unit_size);
+    }
+    pthread_mutex_unlock(&resource_lock);
+
+    *handle = unit;
     return BSP_SUCCESS;
 }
 
 /**
- * @brief Free a previously allocated hardware resource
+ * @brief Return a unit to its pool
  */
 bsp_error_t bsp_free_resource(bsp_resource_handle_t handle) {
+    resource_pool_t* pool = NULL;
+
     if (handle == NULL) {
         return BSP_ERROR_INVALID_PARAM;
     }
@@ -119,36 +194,64 @@ bsp_error_t bsp_free_resource(bsp_resource_handle_t handle) {
     if (!bsp_is_initialized()) {
         return BSP_ERROR_NOT_INITIALIZED;
     }
-    
-    // Find the resource in the list
-    resource_entry_t* prev = NULL;
-    resource_entry_t* current = resource_list;
-    
-    while (current != NULL) {
-        if (current->handle == handle) {
-            // Remove from the list
-            if (prev == NULL) {
-                resource_list = current->next;
-            } else {
-                prev->next = current->next;
-            }
-            
-            // Free the resource data
-            free(current->data);
-            
-            // Free the entry
-            free(current);
-            
-            printf("BSP: Freed resource\n");
-            
-            return BSP_SUCCESS;
-        }
-        
-        prev = current;
-        current = current->next;
+
+    pthread_mutex_lock(&resource_lock);
+    resource_unit_t* unit = bsp_resource_unit(handle, &pool);
+    if (unit == NULL || !unit->in_use) {
+        pthread_mutex_unlock(&resource_lock);
+        return BSP_ERROR_INVALID_PARAM; // Not allocated, or freed twice
     }
-    
-    return BSP_ERROR_INVALID_PARAM; // Handle not found
+
+    // LIFO: the unit freed last is the next one handed out, still in cache
+    unit->in_use = false;
+    unit->next_free = pool->free_head;
+    pool->free_head = (uint32_t)(unit - pool->units);
+    pool->used--;
+    pthread_mutex_unlock(&resource_lock);
+
+    return BSP_SUCCESS;
+}
+
+/**
+ * @brief Get the memory behind an allocated unit
+ */
+void* bsp_resource_data(bsp_resource_handle_t handle) {
+    resource_pool_t* pool = NULL;
+    void* data = NULL;
+
+    pthread_mutex_lock(&resource_lock);
+    resource_unit_t* unit = bsp_resource_unit(handle, &pool);
+    if (unit != NULL && unit->in_use && pool->memory != NULL) {
+        data = pool->memory + (size_t)(unit - pool->units) * pool->unit_size;
+    }
+    pthread_mutex_unlock(&resource_lock);
+
+    return data;
+}
+
+/**
+ * @brief Get the occupancy of a resource pool
+ */
+bsp_error_t bsp_get_resource_usage(bsp_resource_type_t resource_type, bsp_resource_usage_t* usage) {
+    if (usage == NULL || (uint32_t)resource_type >= BSP_RESOURCE_TYPE_COUNT) {
+        return BSP_ERROR_INVALID_PARAM;
+    }
+
+    if (!bsp_is_initialized()) {
+        return BSP_ERROR_NOT_INITIALIZED;
+    }
+
+    pthread_mutex_lock(&resource_lock);
+    const resource_pool_t* pool = &resource_pools[resource_type];
+    usage->total = pool->count;
+    usage->used = pool->used;
+    usage->peak = pool->peak;
+    usage->failures = pool->failures;
+    usage->unit_size = pool->unit_size;
+    usage->entries = pool->entries;
+    pthread_mutex_unlock(&resource_lock);
+
+    return BSP_SUCCESS;
 }
 
 /**
@@ -329,22 +432,10 @@ bsp_error_t bsp_port_update_stats(uint32_t port_id, uint32_t rx_bytes, uint32_t
  * @brief Clean up all resources
  */
 void bsp_cleanup_resources(void) {
-    // Free all allocated resources
-    resource_entry_t* res_current = resource_list;
-    resource_entry_t* res_next;
-    
-    while (res_current != NULL) {
-        res_next = res_current->next;
-        
-        if (res_current->data != NULL) {
-            free(res_current->data);
-        }
-        
-        free(res_current);
-        res_current = res_next;
-    }
-    
-    resource_list = NULL;
+    // Free the resource pools; outstanding handles become invalid
+    pthread_mutex_lock(&resource_lock);
+    bsp_resource_pools_free();
+    pthread_mutex_unlock(&resource_lock);
     
     // Free all port callbacks
     port_callback_t* cb_current = port_callback_list;
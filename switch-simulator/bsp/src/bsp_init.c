@@ -10,6 +10,7 @@
 // External declarations for functions defined in other BSP files
 extern bsp_error_t bsp_set_config(const bsp_config_t* config);
 extern bsp_error_t bsp_init_port_statuses(uint32_t port_count);
+extern bsp_error_t bsp_resource_pools_init(const bsp_config_t* config);
 extern void bsp_cleanup_resources(void);
 extern bool bsp_is_config_initialized(void);
 
@@ -40,6 +41,13 @@ bsp_error_t bsp_init(const bsp_config_t* config) {
     if (result != BSP_SUCCESS) {
         return result;
     }
+
+    // Resource pools sized by the board profile
+    result = bsp_resource_pools_init(config);
+    if (result != BSP_SUCCESS) {
+        bsp_cleanup_resources();
+        return result;
+    }
     
     // Initialize ports
     for (uint32_t i = 0; i < config->num_ports; i++) {
@@ -0,0 +1,149 @@
+/**
+ * @file eth_host_io.h
+ * @brief Ethernet ports backed by host interfaces (veth, tap, NICs)
+ *
+ * Two backends move frames between a host interface and packet buffers:
+ *
+ *  - AF_XDP: the segment pool is registered as the socket's UMEM, so the
+ *    kernel writes received frames straight into segments and transmits
+ *    pooled segments in place. A small XDP program redirects the bound
+ *    queue to the socket; other queues go to the host stack as before.
+ *  - PACKET_MMAP (TPACKET_V3): a block RX ring and a TX ring shared with
+ *    the kernel. Frames are copied between the rings and packet buffers.
+ *    Used when AF_XDP cannot be set up (old kernel, no XDP support).
+ *
+ * Either way TX is batched: a burst is queued on the ring and the kernel
+ * is kicked once, and AF_XDP completions are reaped a ring at a time.
+ *
+ * A port is received from one thread and transmitted from one thread at a
+ * time; the caller serializes transmitters.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_DRIVERS_INCLUDE_ETH_HOST_IO_H
+#define SDK_ES_SWITCH_SIMULATOR_DRIVERS_INCLUDE_ETH_HOST_IO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "hal/packet.h"
+
+#define ETH_HOST_IFNAME_LEN         16      /**< As IFNAMSIZ */
+#define ETH_HOST_DEFAULT_RING_SIZE  1024    /**< Descriptors per ring */
+#define ETH_HOST_MAX_RING_SIZE      16384
+
+/* Host I/O backends */
+typedef enum {
+    ETH_HOST_AF_XDP = 0,            /* AF_XDP, falling back to PACKET_MMAP */
+    ETH_HOST_PACKET_MMAP            /* PACKET_MMAP only */
+} eth_host_backend_t;
+
+/* Host port parameters */
+typedef struct {
+    const char *ifname;             /* Host interface */
+    eth_host_backend_t backend;
+    uint32_t queue_id;              /* AF_XDP: interface queue bound */
+    uint32_t ring_size;             /* Descriptors per ring, a power of two, 0 for the default */
+    uint32_t mtu;                   /* Largest frame payload, 0 for 1500 */
+    bool promiscuous;
+} eth_host_config_t;
+
+/* Host port counters */
+typedef struct {
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t no_buffer;             /* Frames dropped or ring refills cut short for lack of buffers */
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t tx_zero_copy;          /* AF_XDP: segments transmitted in place */
+    uint64_t tx_copied;             /* Frames copied to the TX ring or into a segment */
+    uint64_t tx_dropped;            /* Frames too large for a ring frame */
+    uint64_t tx_ring_full;          /* Bursts cut short by a full ring */
+    uint64_t tx_kicks;              /* Transmit system calls */
+} eth_host_stats_t;
+
+typedef struct eth_host_port eth_host_port_t;
+
+/**
+ * @brief Open a host port
+ *
+ * The interface must exist; AF_XDP needs it up. Each AF_XDP port keeps
+ * ring_size segments posted for reception.
+ *
+ * @param config Parameters
+ * @param[out] port New port
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NOT_FOUND
+ *         if there is no such interface, STATUS_NOT_INITIALIZED before the
+ *         packet subsystem, STATUS_NO_MEMORY, or STATUS_FAILURE if neither
+ *         backend can be set up
+ */
+status_t eth_host_open(const eth_host_config_t *config, eth_host_port_t **port);
+
+/**
+ * @brief Close a host port and return its buffers to the pool
+ *
+ * @param port Port, may be NULL
+ */
+void eth_host_close(eth_host_port_t *port);
+
+/**
+ * @brief Get the backend a port ended up with
+ */
+eth_host_backend_t eth_host_get_backend(const eth_host_port_t *port);
+
+/**
+ * @brief Receive a burst of frames
+ *
+ * AF_XDP frames are the segments the kernel wrote them into; PACKET_MMAP
+ * frames are copied. The caller owns the returned packets.
+ *
+ * @param port Port
+ * @param[out] pkts Received packets
+ * @param max Size of pkts
+ * @return Number of packets received
+ */
+uint32_t eth_host_rx_burst(eth_host_port_t *port, packet_buffer_t **pkts, uint32_t max);
+
+/**
+ * @brief Wait until frames may be received
+ *
+ * @param port Port
+ * @param timeout_ms Longest wait, -1 for no limit
+ * @return true if frames are ready, false on timeout
+ */
+bool eth_host_wait(eth_host_port_t *port, int timeout_ms);
+
+/**
+ * @brief Transmit a burst of frames
+ *
+ * Takes ownership of the accepted packets, a prefix of pkts; the rest
+ * found the ring full. Unshared single segments from the segment pool are
+ * transmitted in place by AF_XDP, everything else is copied. Frames
+ * larger than a ring frame are accepted and dropped.
+ *
+ * @param port Port
+ * @param pkts Packets to transmit
+ * @param count Number of packets
+ * @return Number of packets accepted
+ */
+uint32_t eth_host_tx_burst(eth_host_port_t *port, packet_buffer_t **pkts, uint32_t count);
+
+/**
+ * @brief Transmit a copy of one frame
+ *
+ * @param port Port
+ * @param packet Frame, left to the caller
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER if the frame
+ *         is too large, STATUS_RESOURCE_BUSY if the ring is full
+ */
+status_t eth_host_tx_copy(eth_host_port_t *port, const packet_buffer_t *packet);
+
+/**
+ * @brief Get the counters of a port
+ *
+ * @param port Port
+ * @param[out] stats Counters
+ */
+void eth_host_get_stats(const eth_host_port_t *port, eth_host_stats_t *stats);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_DRIVERS_INCLUDE_ETH_HOST_IO_H */
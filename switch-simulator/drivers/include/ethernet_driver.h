@@ -36,6 +36,16 @@
  */
 #define ETH_MIN_FRAME_SIZE             60
 
+/**
+ * @brief Unicast address filter of a port: buckets and addresses per bucket
+ *
+ * Like a NIC's perfect-match table, it holds at most
+ * ETH_MAC_FILTER_BUCKETS * ETH_MAC_FILTER_WAYS addresses, and fewer when
+ * addresses crowd into one bucket.
+ */
+#define ETH_MAC_FILTER_BUCKETS         16
+#define ETH_MAC_FILTER_WAYS            4
+
 /**
  * @brief Ethernet driver operational modes
  */
@@ -79,6 +89,20 @@ typedef enum {
     ETH_STATUS_AUTO_NEG_ACTIVE = (1 << 7)    /**< Auto-negotiation active */
 } eth_status_flags_t;
 
+/**
+ * @brief Where an Ethernet port's frames go
+ */
+typedef enum {
+    ETH_BACKEND_SIM = 0,           /**< Simulated port in memory */
+    ETH_BACKEND_AF_XDP,            /**< Host interface over AF_XDP, PACKET_MMAP if unavailable */
+    ETH_BACKEND_PACKET_MMAP        /**< Host interface over a TPACKET_V3 packet socket */
+} eth_backend_t;
+
+/**
+ * @brief Length of a host interface name, terminator included
+ */
+#define ETH_HOST_IFNAME_MAX            16
+
 /**
  * @brief Ethernet port configuration structure
  */
@@ -91,6 +115,10 @@ typedef struct {
     bool flow_control_enabled;             /**< Flow control enabled flag */
     bool promiscuous_mode;                 /**< Promiscuous mode flag */
     bool loopback_mode;                    /**< Loopback mode flag */
+    eth_backend_t backend;                 /**< Simulated or host port */
+    char host_ifname[ETH_HOST_IFNAME_MAX]; /**< Host interface of a host port */
+    uint16_t host_queue;                   /**< Host interface queue bound by AF_XDP */
+    uint16_t host_ring_size;               /**< Descriptors per host ring, 0 for the default */
 } eth_port_config_t;
 
 /**
@@ -118,6 +146,8 @@ typedef struct {
     uint64_t rx_undersized;        /**< Undersized frames received */
     uint64_t rx_pause_frames;      /**< PAUSE frames received */
     uint64_t tx_pause_frames;      /**< PAUSE frames transmitted */
+    uint64_t rx_mac_filtered;      /**< Unicast frames dropped by the MAC filter */
+    uint64_t rx_vlan_filtered;     /**< Tagged frames dropped by the VLAN filter */
 } eth_port_stats_t;
 
 /**
@@ -142,6 +172,23 @@ typedef struct {
  */
 typedef int (*eth_rx_callback_t)(uint16_t port_id, const packet_t *packet, void *user_data);
 
+/**
+ * @brief Frames a poll-mode port holds for its poller
+ */
+#define ETH_RX_RING_SIZE               1024
+
+/**
+ * @brief RX interrupt coalescing of a poll-mode port
+ *
+ * A poller sleeping in eth_port_rx_wait() is woken once max_packets frames
+ * are queued, or once the oldest queued frame has waited max_usecs,
+ * whichever comes first.
+ */
+typedef struct {
+    uint32_t max_packets;          /**< Frames that wake the poller at once, 0 for 1 */
+    uint32_t max_usecs;            /**< Longest a queued frame waits for a wakeup, 0 for none */
+} eth_rx_coalesce_t;
+
 /**
  * @brief Initialize Ethernet driver subsystem
  *
@@ -164,6 +211,10 @@ status_t eth_driver_shutdown(void);
 /**
  * @brief Open an Ethernet port for use
  *
+ * A host port (config->backend other than ETH_BACKEND_SIM) gets a receive
+ * thread that hands frames to the RX callback if one is registered, and
+ * to the simulator's ingress queue of the same port otherwise.
+ *
  * @param port_id Port identifier to open (0-based)
  * @param config Initial port configuration
  *
@@ -259,6 +310,46 @@ status_t eth_port_register_rx_callback(uint16_t port_id, eth_rx_callback_t callb
  */
 status_t eth_port_unregister_rx_callback(uint16_t port_id);
 
+/**
+ * @brief Switch a port between callback and poll-mode reception
+ *
+ * In poll mode received frames are queued on the port's RX ring for
+ * eth_port_rx_burst() instead of going to the RX callback. Change modes
+ * only while no thread polls the port; frames still queued when poll mode
+ * is turned off are freed.
+ *
+ * @param port_id Port identifier
+ * @param enable true for poll mode
+ * @param coalesce Wakeup coalescing, NULL to wake on every frame
+ *
+ * @return STATUS_SUCCESS on success, error code otherwise
+ */
+status_t eth_port_set_rx_poll_mode(uint16_t port_id, bool enable, const eth_rx_coalesce_t *coalesce);
+
+/**
+ * @brief Take a burst of received frames from a poll-mode port
+ *
+ * Returns whatever is queued, without waiting. One thread polls a port.
+ * The caller owns the returned packets.
+ *
+ * @param port_id Port identifier
+ * @param[out] pkts Received packets
+ * @param n Size of pkts
+ *
+ * @return Number of packets taken, 0 if none or not in poll mode
+ */
+uint32_t eth_port_rx_burst(uint16_t port_id, packet_t **pkts, uint32_t n);
+
+/**
+ * @brief Sleep until a poll-mode port has frames by its coalescing rules
+ *
+ * @param port_id Port identifier
+ * @param timeout_us Longest wait
+ *
+ * @return true if frames are ready, false on timeout or if not in poll mode
+ */
+bool eth_port_rx_wait(uint16_t port_id, uint32_t timeout_us);
+
 /**
  * @brief Transmit a packet on a port
  *
@@ -269,20 +360,49 @@ status_t eth_port_unregister_rx_callback(uint16_t port_id);
  */
 status_t eth_port_tx_packet(uint16_t port_id, const packet_t *packet);
 
+/**
+ * @brief Transmit a burst of packets on a port, handing them over
+ *
+ * On host ports the burst is queued on the TX ring with one kernel kick,
+ * and AF_XDP sends pool segments in place. Simulated ports transmit the
+ * packets one by one. The accepted packets, a prefix of pkts, belong to
+ * the driver afterwards; the rest stay with the caller.
+ *
+ * @param port_id Port identifier
+ * @param pkts Packets to transmit
+ * @param count Number of packets
+ *
+ * @return Number of packets accepted
+ */
+uint32_t eth_port_tx_burst(uint16_t port_id, packet_t **pkts, uint32_t count);
+
 /**
  * @brief Set MAC address filtering for a port
  *
+ * Once a port that is not promiscuous has an address in its filter, the
+ * driver drops received unicast frames addressed to neither the port's
+ * own address nor a filtered one, before they are counted as received
+ * or reach the RX callback, the poll ring or the pipeline; they are
+ * counted in rx_mac_filtered. Multicast and broadcast frames pass.
+ * Removing the last address turns the filter off.
+ *
  * @param port_id Port identifier
  * @param mac_addr MAC address
  * @param add true to add address to filter, false to remove
  *
- * @return STATUS_SUCCESS on success, error code otherwise
+ * @return STATUS_SUCCESS on success, STATUS_RESOURCE_EXHAUSTED if the
+ *         address's bucket is full, error code otherwise
  */
 status_t eth_port_set_mac_filter(uint16_t port_id, const uint8_t mac_addr[6], bool add);
 
 /**
  * @brief Set VLAN filtering for a port
  *
+ * While a port has VLANs in its filter, the driver drops received frames
+ * tagged (802.1Q or 802.1ad) with any other VLAN ID, counting them in
+ * rx_vlan_filtered. Untagged and priority-tagged frames pass. Removing
+ * the last VLAN turns the filter off.
+ *
  * @param port_id Port identifier
  * @param vlan_id VLAN ID to filter
  * @param add true to add VLAN to filter, false to remove
@@ -0,0 +1,172 @@
+/**
+ * @file pcap_driver.h
+ * @brief Replay of pcap/pcapng captures into ports and capture of port egress
+ *
+ * Replay maps the whole file and feeds its Ethernet frames to a port's RX
+ * ring in bursts, at the capture's own pace, scaled, or as fast as the
+ * ring takes them. Both classic pcap (microsecond and nanosecond, either
+ * byte order) and pcapng (enhanced and simple packet blocks, any number of
+ * sections and interfaces) are read. A pcapng file whose interfaces are
+ * named "port0", "port1" and so on can be replayed into those ports, each
+ * frame into the port it was recorded on (see workload.h).
+ *
+ * Capture becomes the port's egress driver: every frame the port sends is
+ * recorded into a lock-free byte ring and then sent on as before. A writer
+ * thread moves the ring to a nanosecond pcap file in large writes.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_DRIVERS_INCLUDE_PCAP_DRIVER_H
+#define SDK_ES_SWITCH_SIMULATOR_DRIVERS_INCLUDE_PCAP_DRIVER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "hal/driver.h"
+
+#define PCAP_REPLAY_DEFAULT_BURST     32
+#define PCAP_CAPTURE_DEFAULT_RING     (4u << 20)  /**< Bytes */
+#define PCAP_CAPTURE_DEFAULT_SNAPLEN  65535
+
+/* Replay pacing */
+typedef enum {
+    PCAP_REPLAY_ORIGINAL = 0,       /* Gaps between frames as captured */
+    PCAP_REPLAY_SCALED,             /* Gaps divided by speed */
+    PCAP_REPLAY_MAX_RATE            /* No gaps; waits for RX ring space instead of dropping */
+} pcap_replay_timing_t;
+
+/* Replay parameters */
+typedef struct {
+    port_id_t port;                 /* Ingress port */
+    pcap_replay_timing_t timing;
+    double speed;                   /* PCAP_REPLAY_SCALED: 2.0 replays twice as fast */
+    uint32_t burst;                 /* Frames per RX burst, 0 for the default */
+    bool loop;                      /* Start over at the end until stopped */
+    bool by_interface;              /* pcapng: frames of interface "portN" go to port N, not port */
+} pcap_replay_config_t;
+
+/* Replay counters */
+typedef struct {
+    uint64_t packets;               /* Frames queued on the RX ring */
+    uint64_t bytes;
+    uint64_t dropped;               /* Frames that found the RX ring full or no buffer */
+    uint64_t skipped;               /* Records not replayed: other link types, bad lengths */
+    uint64_t loops;                 /* Passes completed over the file */
+    bool done;                      /* The file was replayed; false while looping */
+} pcap_replay_stats_t;
+
+/* Capture parameters */
+typedef struct {
+    port_id_t port;                 /* Egress port */
+    uint32_t ring_size;             /* Ring bytes, a power of two, 0 for the default */
+    uint32_t snaplen;               /* Bytes kept per frame, 0 for the default */
+} pcap_capture_config_t;
+
+/* Capture counters */
+typedef struct {
+    uint64_t packets;               /* Frames recorded */
+    uint64_t bytes;                 /* Frame bytes recorded */
+    uint64_t dropped;               /* Frames not recorded for lack of ring space */
+    uint64_t file_bytes;            /* Bytes written to the file */
+    uint64_t writes;                /* Write system calls */
+} pcap_capture_stats_t;
+
+typedef struct pcap_replay pcap_replay_t;
+typedef struct pcap_capture pcap_capture_t;
+
+/**
+ * @brief Map a capture file for replay
+ *
+ * @param path Capture file
+ * @param[out] replay New replay
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NOT_FOUND
+ *         if the file cannot be opened, STATUS_INVALID_PACKET if it is not
+ *         pcap or pcapng, STATUS_NO_MEMORY
+ */
+status_t pcap_replay_open(const char *path, pcap_replay_t **replay);
+
+/**
+ * @brief Start replaying on a thread of its own
+ *
+ * @param replay Replay, not running
+ * @param config Parameters
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER,
+ *         STATUS_RESOURCE_BUSY if already running, STATUS_FAILURE
+ */
+status_t pcap_replay_start(pcap_replay_t *replay, const pcap_replay_config_t *config);
+
+/**
+ * @brief Stop replaying and wait for the thread
+ *
+ * @param replay Replay
+ */
+void pcap_replay_stop(pcap_replay_t *replay);
+
+/**
+ * @brief Stop replaying and unmap the file
+ *
+ * @param replay Replay, may be NULL
+ */
+void pcap_replay_close(pcap_replay_t *replay);
+
+/**
+ * @brief Get the comments of the first section header of a pcapng file
+ *
+ * Several comments are concatenated.
+ *
+ * @param replay Replay
+ * @param buf Output buffer, NUL-terminated
+ * @param size Size of buf
+ * @param[out] length Length of the comments, which are truncated if not less than size
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NOT_FOUND
+ *         if there are none
+ */
+status_t pcap_replay_get_comment(const pcap_replay_t *replay, char *buf, size_t size, size_t *length);
+
+/**
+ * @brief Get the counters of a replay
+ *
+ * @param replay Replay
+ * @param[out] stats Counters
+ */
+void pcap_replay_get_stats(const pcap_replay_t *replay, pcap_replay_stats_t *stats);
+
+/**
+ * @brief Start capturing a port's egress to a file
+ *
+ * The capture replaces the port's driver and sends every frame on through
+ * the previous driver, or the simulator when there was none. The file is
+ * created or truncated.
+ *
+ * @param path Capture file
+ * @param config Parameters
+ * @param[out] capture New capture
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_FAILURE
+ *         if the file cannot be written, STATUS_NO_MEMORY, or the port error
+ */
+status_t pcap_capture_open(const char *path, const pcap_capture_config_t *config,
+                           pcap_capture_t **capture);
+
+/**
+ * @brief Give the port its previous driver back, flush and close the file
+ *
+ * Call once no TX drain of the port is in progress.
+ *
+ * @param capture Capture, may be NULL
+ */
+void pcap_capture_close(pcap_capture_t *capture);
+
+/**
+ * @brief Get the driver a capture installed on its port
+ */
+driver_handle_t pcap_capture_get_driver(pcap_capture_t *capture);
+
+/**
+ * @brief Get the counters of a capture
+ *
+ * @param capture Capture
+ * @param[out] stats Counters
+ */
+void pcap_capture_get_stats(const pcap_capture_t *capture, pcap_capture_stats_t *stats);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_DRIVERS_INCLUDE_PCAP_DRIVER_H */
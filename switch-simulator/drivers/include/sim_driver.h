@@ -36,6 +36,17 @@ typedef enum {
     SIM_ERROR_NOT_INITIALIZED
 } sim_status_t;
 
+/* Traffic generator limits */
+#define SIM_MAX_GENERATORS 16
+#define SIM_DST_RANDOM UINT32_MAX   /* Destination: any other port, picked per template */
+
+/* Offered load of a port */
+typedef struct {
+    uint32_t rate_pps;              /* Packets per second, 0 for an even share of traffic_rate */
+    uint16_t packet_size;           /* Frame size, 0 for sizes spread over 64..1518 */
+    uint32_t dst_port;              /* Destination port or SIM_DST_RANDOM */
+} sim_traffic_profile_t;
+
 /* Port status in simulation */
 typedef struct {
     bool link_up;
@@ -46,6 +57,7 @@ typedef struct {
 /* Simulation statistics */
 typedef struct {
     uint64_t packets_generated;
+    uint64_t bytes_generated;
     uint64_t packets_dropped;
     uint64_t link_state_changes;
     uint64_t running_time_ms;
@@ -58,7 +70,11 @@ typedef struct {
     uint32_t tick_interval_ms;
     uint32_t traffic_rate;
     double link_flap_probability;
+    uint32_t num_generators;
+    bool pin_generators;
     sim_port_status_t *port_status;
+    sim_traffic_profile_t *profiles;
+    uint32_t plan_generation;       /* Bumped whenever the offered load changes */
     sim_statistics_t stats;
 } sim_context_t;
 
@@ -68,6 +84,8 @@ typedef struct {
     uint32_t tick_interval_ms;
     uint32_t traffic_rate;
     double link_flap_probability;
+    uint32_t num_generators;     /* Traffic generator threads, 0 for one */
+    bool pin_generators;         /* Pin generator threads to consecutive CPUs */
     void *sim_context;  /* Filled by sim_driver_init */
 } sim_config_t;
 
@@ -139,9 +157,26 @@ sim_status_t sim_set_port_state(void *context, uint32_t port_id, bool link_up);
  */
 sim_status_t sim_set_traffic_generation(void *context, uint32_t port_id, bool enable);
 
+/**
+ * Set the offered load of a port
+ *
+ * Ports without a rate of their own share traffic_rate evenly among the
+ * ports with traffic enabled.
+ *
+ * @param context Simulation context
+ * @param port_id Port identifier
+ * @param profile Offered load, NULL for the defaults
+ * @return SIM_SUCCESS on success, error code otherwise
+ */
+sim_status_t sim_set_traffic_profile(void *context, uint32_t port_id, const sim_traffic_profile_t *profile);
+
 /**
  * Register packet handler callback
  *
+ * Generated packets reach the handler from the generator threads, each
+ * port always from the same thread, so the handler may run concurrently
+ * for different ports.
+ *
  * @param callback Function to call when a packet is simulated
  * @param context User context to pass to the callback
  * @return SIM_SUCCESS on success, error code otherwise
@@ -0,0 +1,116 @@
+/**
+ * @file workload.h
+ * @brief Recorded workloads for repeatable benchmark runs, and egress digests
+ *
+ * A workload is a pcapng file: its section header names the application
+ * (WORKLOAD_USER_APPL) and carries the switch configuration the traffic
+ * was recorded against as a comment, in the JSON of config_model.h; one
+ * Ethernet interface per ingress port, named "port<N>", with nanosecond
+ * timestamps; and the frames in arrival order. Any pcapng reader opens it,
+ * and pcap_replay_start() with by_interface set feeds every frame back
+ * into the port it arrived on, at its recorded time or as fast as the
+ * rings take it.
+ *
+ * A recording taps every port's RX (hw_sim_set_rx_tap()), so whatever
+ * drives the ports, the traffic generator or a capture replay, is written
+ * down. The digest stands in front of every port's egress driver like a
+ * capture and sums a hash of each frame sent with its port. The sum does
+ * not depend on the order in which workers and ports send, so two runs of
+ * the same workload on the same build should agree, and a change that
+ * alters forwarding shows up as a different digest. Frames the switch
+ * originates on its own (LACP, ICMP errors, aging) are counted like any
+ * other, so runs meant to be compared should configure them alike.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_DRIVERS_INCLUDE_WORKLOAD_H
+#define SDK_ES_SWITCH_SIMULATOR_DRIVERS_INCLUDE_WORKLOAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+
+#define WORKLOAD_USER_APPL      "switch-simulator workload"
+
+/* Egress digest */
+typedef struct {
+    uint64_t packets;               /* Frames sent */
+    uint64_t bytes;
+    uint64_t value;                 /* Sum of the frame hashes */
+} workload_digest_t;
+
+typedef struct workload_writer workload_writer_t;
+
+/**
+ * @brief Create a workload file
+ *
+ * @param path File to create
+ * @param config Configuration of the run as JSON, NULL for none
+ * @param[out] writer New writer
+ * @return STATUS_SUCCESS on success, error code otherwise
+ */
+status_t workload_writer_open(const char *path, const char *config, workload_writer_t **writer);
+
+/**
+ * @brief Append a frame; calls from several threads are serialized
+ *
+ * @param writer Writer
+ * @param port Ingress port
+ * @param time_ns Arrival time, nanoseconds from any fixed origin
+ * @param data Frame
+ * @param len Frame length
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t workload_writer_add(workload_writer_t *writer, port_id_t port, uint64_t time_ns,
+                             const uint8_t *data, uint32_t len);
+
+/**
+ * @brief Flush and close a workload file
+ *
+ * @param writer Writer, may be NULL
+ * @return STATUS_SUCCESS, STATUS_FAILURE if any write failed
+ */
+status_t workload_writer_close(workload_writer_t *writer);
+
+/**
+ * @brief Record every frame the ports receive from now on
+ *
+ * Arrival times are taken from the monotonic clock.
+ *
+ * @param path File to create
+ * @param config Configuration of the run as JSON, NULL for none
+ * @return STATUS_SUCCESS on success, STATUS_ALREADY_INITIALIZED while
+ *         recording, error code of workload_writer_open() otherwise
+ */
+status_t workload_record_start(const char *path, const char *config);
+
+/**
+ * @brief Stop recording and close the file
+ *
+ * @param[out] packets Frames recorded, may be NULL
+ * @return STATUS_SUCCESS, STATUS_NOT_INITIALIZED if not recording,
+ *         STATUS_FAILURE if any write failed
+ */
+status_t workload_record_stop(uint64_t *packets);
+
+/**
+ * @brief Start digesting the egress of every port
+ *
+ * @return STATUS_SUCCESS on success, STATUS_ALREADY_INITIALIZED if
+ *         started, error code otherwise
+ */
+status_t workload_digest_start(void);
+
+/**
+ * @brief Read the digest so far
+ *
+ * @param[out] digest Digest
+ */
+void workload_digest_get(workload_digest_t *digest);
+
+/**
+ * @brief Put back the egress drivers the digest stood in front of
+ */
+void workload_digest_stop(void);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_DRIVERS_INCLUDE_WORKLOAD_H */
@@ -0,0 +1,1011 @@
+/**
+ * @file eth_host_io.c
+ * @brief AF_XDP and PACKET_MMAP host interface backends
+ *
+ * AF_XDP registers the whole segment pool arena as UMEM in unaligned chunk
+ * mode: every segment slot's buffer (headroom and data) is one chunk,
+ * addressed by its offset in the arena. Segments posted to the fill ring
+ * come back on the RX ring with the frame XDP_PACKET_HEADROOM bytes into
+ * the buffer, and become packets by moving their data pointer. Segments
+ * transmitted in place carry the offset of their data; they are freed when
+ * the completion ring returns it. The slot of any address is found by
+ * dividing by the slot size.
+ *
+ * The rings follow the kernel's single producer, single consumer scheme:
+ * the producer publishes with a release store, the consumer reads the
+ * other side with an acquire load.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/bpf.h>
+
+#include "eth_host_io.h"
+#include "common/logging.h"
+#include "common/config.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#define ETH_HOST_DEFAULT_MTU        1500
+#define ETH_HOST_L2_OVERHEAD        22      /* Ethernet header, one VLAN tag, FCS */
+#define ETH_HOST_XSK_MAP_ENTRIES    64      /* Queues the XDP program can redirect */
+#define ETH_HOST_XSK_KICK_BATCH     32      /* Frames the kernel sends per copy mode kick */
+#define ETH_HOST_TP_BLOCK_SIZE      (1u << 18)
+#define ETH_HOST_TP_RX_BLOCKS       8
+#define ETH_HOST_TP_RETIRE_MS       1
+#define ETH_HOST_TP_TX_OFFSET       TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+
+/* Slot states, AF_XDP */
+#define ETH_HOST_SLOT_FREE          0       /* Not held by the kernel */
+#define ETH_HOST_SLOT_FILL          1       /* Posted for reception */
+#define ETH_HOST_SLOT_TX            2       /* Queued for transmission */
+
+/* One mmap()ed AF_XDP ring */
+typedef struct {
+    uint32_t *producer;
+    uint32_t *consumer;
+    uint32_t *flags;
+    void *desc;
+    uint32_t mask;
+    uint32_t size;
+    uint32_t head;                  /* Our producer or consumer index */
+    void *map;
+    size_t map_size;
+} eth_xsk_ring_t;
+
+/* AF_XDP state */
+typedef struct {
+    eth_xsk_ring_t fill;
+    eth_xsk_ring_t comp;
+    eth_xsk_ring_t rx;
+    eth_xsk_ring_t tx;
+    packet_pool_region_t region;
+    uint8_t *slot_state;            /* ETH_HOST_SLOT_* per pool slot */
+    uint32_t fill_posted;
+    uint32_t tx_outstanding;        /* Queued, completion not yet reaped */
+    int map_fd;
+    int prog_fd;
+    int link_fd;
+} eth_xsk_t;
+
+/* PACKET_MMAP state */
+typedef struct {
+    uint8_t *map;
+    size_t map_size;
+    uint8_t *rx_ring;
+    uint8_t *tx_ring;
+    uint32_t rx_block_nr;
+    uint32_t rx_block;              /* Block being read */
+    uint32_t rx_left;               /* Packets left in it */
+    struct tpacket3_hdr *rx_next;   /* Next packet in it */
+    uint32_t tx_frame_size;
+    uint32_t tx_frame_nr;
+    uint32_t tx_head;
+} eth_tpacket_t;
+
+struct eth_host_port {
+    char ifname[ETH_HOST_IFNAME_LEN];
+    eth_host_backend_t backend;
+    int fd;
+    int ifindex;
+    uint32_t queue_id;
+    uint32_t ring_size;
+    uint32_t max_frame;
+    eth_host_stats_t stats;
+    union {
+        eth_xsk_t xsk;
+        eth_tpacket_t tp;
+    } u;
+};
+
+static inline uint32_t eth_load_acquire(const uint32_t *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void eth_store_release(uint32_t *p, uint32_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+/* ------------------------------------------------------------------------ */
+/* AF_XDP                                                                   */
+/* ------------------------------------------------------------------------ */
+
+static long eth_bpf(int cmd, union bpf_attr *attr) {
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/**
+ * @brief Load the XDP program redirecting queues to the XSKMAP
+ *
+ *   r2 = ctx->rx_queue_index
+ *   r1 = map
+ *   r3 = XDP_PASS              (action if the queue has no socket)
+ *   return bpf_redirect_map(r1, r2, r3)
+ */
+static int eth_xsk_load_prog(int map_fd) {
+    struct bpf_insn insns[] = {
+        { .code = BPF_LDX | BPF_MEM | BPF_W, .dst_reg = BPF_REG_2, .src_reg = BPF_REG_1,
+          .off = offsetof(struct xdp_md, rx_queue_index) },
+        { .code = BPF_LD | BPF_DW | BPF_IMM, .dst_reg = BPF_REG_1,
+          .src_reg = BPF_PSEUDO_MAP_FD, .imm = map_fd },
+        { 0 },
+        { .code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_3, .imm = XDP_PASS },
+        { .code = BPF_JMP | BPF_CALL, .imm = BPF_FUNC_redirect_map },
+        { .code = BPF_JMP | BPF_EXIT },
+    };
+    static const char license[] = "GPL";
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insn_cnt = sizeof(insns) / sizeof(insns[0]);
+    attr.insns = (uint64_t)(uintptr_t)insns;
+    attr.license = (uint64_t)(uintptr_t)license;
+    return (int)eth_bpf(BPF_PROG_LOAD, &attr);
+}
+
+/**
+ * @brief Create the XSKMAP, load the program, attach it and add the socket
+ */
+static status_t eth_xsk_attach(eth_host_port_t *port) {
+    eth_xsk_t *xsk = &port->u.xsk;
+    union bpf_attr attr;
+
+    if (port->queue_id >= ETH_HOST_XSK_MAP_ENTRIES) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = ETH_HOST_XSK_MAP_ENTRIES;
+    xsk->map_fd = (int)eth_bpf(BPF_MAP_CREATE, &attr);
+    if (xsk->map_fd < 0) {
+        LOG_WARNING(LOG_CATEGORY_DRIVER, "%s: cannot create XSKMAP: %s", port->ifname, strerror(errno));
+        return STATUS_FAILURE;
+    }
+
+    xsk->prog_fd = eth_xsk_load_prog(xsk->map_fd);
+    if (xsk->prog_fd < 0) {
+        LOG_WARNING(LOG_CATEGORY_DRIVER, "%s: cannot load XDP program: %s", port->ifname, strerror(errno));
+        return STATUS_FAILURE;
+    }
+
+    /* Native XDP where the driver has it, generic XDP otherwise */
+    static const uint32_t modes[] = { XDP_FLAGS_DRV_MODE, XDP_FLAGS_SKB_MODE };
+    for (uint32_t i = 0; i < sizeof(modes) / sizeof(modes[0]) && xsk->link_fd < 0; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.link_create.prog_fd = (uint32_t)xsk->prog_fd;
+        attr.link_create.target_ifindex = (uint32_t)port->ifindex;
+        attr.link_create.attach_type = BPF_XDP;
+        attr.link_create.flags = modes[i];
+        xsk->link_fd = (int)eth_bpf(BPF_LINK_CREATE, &attr);
+    }
+    if (xsk->link_fd < 0) {
+        LOG_WARNING(LOG_CATEGORY_DRIVER, "%s: cannot attach XDP program: %s", port->ifname, strerror(errno));
+        return STATUS_FAILURE;
+    }
+
+    uint32_t key = port->queue_id;
+    uint32_t value = (uint32_t)port->fd;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = (uint32_t)xsk->map_fd;
+    attr.key = (uint64_t)(uintptr_t)&key;
+    attr.value = (uint64_t)(uintptr_t)&value;
+    if (eth_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        LOG_WARNING(LOG_CATEGORY_DRIVER, "%s: cannot add socket to XSKMAP: %s", port->ifname, strerror(errno));
+        return STATUS_FAILURE;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Map one ring of the socket
+ */
+static status_t eth_xsk_map_ring(eth_host_port_t *port, eth_xsk_ring_t *ring,
+                                 const struct xdp_ring_offset *off, size_t desc_size,
+                                 off_t pgoff) {
+    ring->map_size = off->desc + (size_t)port->ring_size * desc_size;
+    ring->map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, port->fd, pgoff);
+    if (ring->map == MAP_FAILED) {
+        ring->map = NULL;
+        return STATUS_FAILURE;
+    }
+
+    uint8_t *base = (uint8_t *)ring->map;
+    ring->producer = (uint32_t *)(base + off->producer);
+    ring->consumer = (uint32_t *)(base + off->consumer);
+    ring->flags = (uint32_t *)(base + off->flags);
+    ring->desc = base + off->desc;
+    ring->size = port->ring_size;
+    ring->mask = port->ring_size - 1;
+    return STATUS_SUCCESS;
+}
+
+static inline bool eth_xsk_in_region(const eth_xsk_t *xsk, const packet_buffer_t *packet) {
+    size_t off = (size_t)((const uint8_t *)packet - xsk->region.base);
+    return (const uint8_t *)packet >= xsk->region.base &&
+           off < (size_t)xsk->region.slot_count * xsk->region.slot_size &&
+           off % xsk->region.slot_size == 0;
+}
+
+/**
+ * @brief Get the segment a UMEM address falls in
+ */
+static inline packet_buffer_t *eth_xsk_slot(const eth_xsk_t *xsk, uint64_t addr, uint32_t *index) {
+    *index = (uint32_t)(addr / xsk->region.slot_size);
+    return (packet_buffer_t *)(xsk->region.base + (size_t)*index * xsk->region.slot_size);
+}
+
+/**
+ * @brief Take a segment of the pool, NULL if only other buffers are left
+ */
+static packet_buffer_t *eth_xsk_segment(eth_host_port_t *port) {
+    packet_buffer_t *segment = packet_segment_alloc();
+
+    if (segment && !eth_xsk_in_region(&port->u.xsk, segment)) {
+        packet_buffer_free(segment);
+        segment = NULL;
+    }
+    if (!segment) {
+        port->stats.no_buffer++;
+    }
+    return segment;
+}
+
+/**
+ * @brief Top the fill ring up with segments
+ */
+static void eth_xsk_refill(eth_host_port_t *port) {
+    eth_xsk_t *xsk = &port->u.xsk;
+    eth_xsk_ring_t *fill = &xsk->fill;
+    uint32_t room = fill->size - (fill->head - eth_load_acquire(fill->consumer));
+    uint32_t want = port->ring_size - xsk->fill_posted;
+    uint32_t n = room < want ? room : want;
+    uint64_t *addrs = (uint64_t *)fill->desc;
+    uint32_t posted = 0;
+
+    while (posted < n) {
+        packet_buffer_t *segment = eth_xsk_segment(port);
+        if (!segment) {
+            break;
+        }
+
+        uint32_t index = (uint32_t)(((uint8_t *)segment - xsk->region.base) / xsk->region.slot_size);
+        xsk->slot_state[index] = ETH_HOST_SLOT_FILL;
+        addrs[(fill->head + posted) & fill->mask] = (uint64_t)(segment->head - xsk->region.base);
+        posted++;
+    }
+
+    if (posted) {
+        fill->head += posted;
+        xsk->fill_posted += posted;
+        eth_store_release(fill->producer, fill->head);
+    }
+}
+
+/**
+ * @brief Free the segments the kernel has finished transmitting
+ */
+static void eth_xsk_reap(eth_host_port_t *port) {
+    eth_xsk_t *xsk = &port->u.xsk;
+    eth_xsk_ring_t *comp = &xsk->comp;
+    uint32_t n = eth_load_acquire(comp->producer) - comp->head;
+    const uint64_t *addrs = (const uint64_t *)comp->desc;
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t index;
+        packet_buffer_t *segment = eth_xsk_slot(xsk, addrs[(comp->head + i) & comp->mask], &index);
+        xsk->slot_state[index] = ETH_HOST_SLOT_FREE;
+        packet_buffer_free(segment);
+    }
+
+    if (n) {
+        comp->head += n;
+        xsk->tx_outstanding -= n;
+        eth_store_release(comp->consumer, comp->head);
+    }
+}
+
+/**
+ * @brief Have the kernel send what the TX ring holds
+ *
+ * Copy mode sends a bounded batch per call, so the kick repeats until the
+ * ring is drained or the kernel pushes back.
+ */
+static void eth_xsk_kick(eth_host_port_t *port) {
+    eth_xsk_ring_t *tx = &port->u.xsk.tx;
+    uint32_t kicks = (port->ring_size + ETH_HOST_XSK_KICK_BATCH - 1) / ETH_HOST_XSK_KICK_BATCH;
+
+    while (kicks-- > 0 && eth_load_acquire(tx->consumer) != tx->head) {
+        if (!(__atomic_load_n(tx->flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP)) {
+            break;
+        }
+        port->stats.tx_kicks++;
+        if (sendto(port->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+            errno != EAGAIN && errno != EBUSY && errno != ENOBUFS) {
+            break;
+        }
+    }
+    eth_xsk_reap(port);
+}
+
+/**
+ * @brief Whether a packet can be transmitted from where it lies
+ *
+ * It must be a segment slot of its own: one segment, data inline, no
+ * other holders of the buffer.
+ */
+static bool eth_xsk_tx_in_place(const eth_xsk_t *xsk, const packet_buffer_t *packet) {
+    const uint8_t *buffer = (const uint8_t *)packet + xsk->region.data_offset;
+
+    return eth_xsk_in_region(xsk, packet) &&
+           (packet->flags & (PACKET_FLAG_POOLED | PACKET_FLAG_EXT_DATA)) == PACKET_FLAG_POOLED &&
+           !packet->shared && !packet->next && packet->slot_refs == 1 &&
+           packet->head == buffer && packet->data >= buffer &&
+           packet->data + packet->length <= buffer + xsk->region.data_size;
+}
+
+/**
+ * @brief Queue one segment on the TX ring; the caller checked for room
+ */
+static void eth_xsk_post_tx(eth_host_port_t *port, packet_buffer_t *segment) {
+    eth_xsk_t *xsk = &port->u.xsk;
+    struct xdp_desc *desc = &((struct xdp_desc *)xsk->tx.desc)[xsk->tx.head & xsk->tx.mask];
+    uint32_t index = (uint32_t)(((uint8_t *)segment - xsk->region.base) / xsk->region.slot_size);
+
+    xsk->slot_state[index] = ETH_HOST_SLOT_TX;
+    desc->addr = (uint64_t)(segment->data - xsk->region.base);
+    desc->len = segment->length;
+    desc->options = 0;
+    xsk->tx.head++;
+    xsk->tx_outstanding++;
+    port->stats.tx_packets++;
+    port->stats.tx_bytes += segment->length;
+}
+
+static uint32_t eth_xsk_tx_room(eth_host_port_t *port) {
+    eth_xsk_t *xsk = &port->u.xsk;
+    uint32_t ring_room = xsk->tx.size - (xsk->tx.head - eth_load_acquire(xsk->tx.consumer));
+    uint32_t comp_room = xsk->comp.size - xsk->tx_outstanding;
+    return ring_room < comp_room ? ring_room : comp_room;
+}
+
+/**
+ * @brief Copy a frame into a fresh segment
+ *
+ * @return The segment, NULL if the frame does not fit or there is none
+ */
+static packet_buffer_t *eth_xsk_copy(eth_host_port_t *port, const packet_buffer_t *packet,
+                                     uint32_t length) {
+    if (length > port->max_frame) {
+        return NULL;
+    }
+
+    packet_buffer_t *segment = eth_xsk_segment(port);
+    if (!segment) {
+        return NULL;
+    }
+    packet_copy_data(packet, 0, segment->data, length);
+    segment->length = length;
+    port->stats.tx_copied++;
+    return segment;
+}
+
+static uint32_t eth_xsk_tx_burst(eth_host_port_t *port, packet_buffer_t **pkts, uint32_t count) {
+    eth_xsk_t *xsk = &port->u.xsk;
+    uint32_t room;
+    uint32_t i;
+
+    eth_xsk_reap(port);
+    room = eth_xsk_tx_room(port);
+
+    for (i = 0; i < count && room > 0; i++) {
+        packet_buffer_t *packet = pkts[i];
+
+        if (eth_xsk_tx_in_place(xsk, packet)) {
+            port->stats.tx_zero_copy++;
+        } else {
+            uint32_t length = packet_chain_length(packet);
+            packet_buffer_t *segment = eth_xsk_copy(port, packet, length);
+            if (!segment) {
+                if (length <= port->max_frame) {
+                    break;          /* Pool exhausted, the rest stays with the caller */
+                }
+                port->stats.tx_dropped++;
+                packet_buffer_free(packet);
+                continue;
+            }
+            packet_buffer_free(packet);
+            packet = segment;
+        }
+        eth_xsk_post_tx(port, packet);
+        room--;
+    }
+
+    if (i < count) {
+        port->stats.tx_ring_full++;
+    }
+    eth_store_release(xsk->tx.producer, xsk->tx.head);
+    eth_xsk_kick(port);
+    return i;
+}
+
+static status_t eth_xsk_tx_copy(eth_host_port_t *port, const packet_buffer_t *packet) {
+    uint32_t length = packet_chain_length(packet);
+
+    if (length > port->max_frame) {
+        port->stats.tx_dropped++;
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    eth_xsk_reap(port);
+    if (eth_xsk_tx_room(port) == 0) {
+        port->stats.tx_ring_full++;
+        return STATUS_RESOURCE_BUSY;
+    }
+
+    packet_buffer_t *segment = eth_xsk_copy(port, packet, length);
+    if (!segment) {
+        return STATUS_RESOURCE_BUSY;
+    }
+    eth_xsk_post_tx(port, segment);
+    eth_store_release(port->u.xsk.tx.producer, port->u.xsk.tx.head);
+    eth_xsk_kick(port);
+    return STATUS_SUCCESS;
+}
+
+static uint32_t eth_xsk_rx_burst(eth_host_port_t *port, packet_buffer_t **pkts, uint32_t max) {
+    eth_xsk_t *xsk = &port->u.xsk;
+    eth_xsk_ring_t *rx = &xsk->rx;
+    uint32_t n = eth_load_acquire(rx->producer) - rx->head;
+    const struct xdp_desc *descs = (const struct xdp_desc *)rx->desc;
+
+    if (n > max) {
+        n = max;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        const struct xdp_desc *desc = &descs[(rx->head + i) & rx->mask];
+        uint64_t addr = (desc->addr & XSK_UNALIGNED_BUF_ADDR_MASK) +
+                        (desc->addr >> XSK_UNALIGNED_BUF_OFFSET_SHIFT);
+        uint32_t index;
+        packet_buffer_t *packet = eth_xsk_slot(xsk, addr, &index);
+
+        xsk->slot_state[index] = ETH_HOST_SLOT_FREE;
+        packet->data = xsk->region.base + addr;
+        packet->length = desc->len;
+        packet->capacity = (uint32_t)(packet->head + xsk->region.data_size - packet->data);
+        port->stats.rx_bytes += desc->len;
+        pkts[i] = packet;
+    }
+
+    if (n) {
+        rx->head += n;
+        xsk->fill_posted -= n;
+        port->stats.rx_packets += n;
+        eth_store_release(rx->consumer, rx->head);
+    }
+
+    eth_xsk_refill(port);
+    if (__atomic_load_n(xsk->fill.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP) {
+        recvfrom(port->fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+    }
+    return n;
+}
+
+static void eth_xsk_close(eth_host_port_t *port) {
+    eth_xsk_t *xsk = &port->u.xsk;
+
+    /* Detach before the socket goes, so the queue falls back to the stack */
+    if (xsk->link_fd >= 0) {
+        close(xsk->link_fd);
+    }
+    if (xsk->prog_fd >= 0) {
+        close(xsk->prog_fd);
+    }
+    if (xsk->map_fd >= 0) {
+        close(xsk->map_fd);
+    }
+    if (port->fd >= 0) {
+        close(port->fd);
+        port->fd = -1;
+    }
+
+    eth_xsk_ring_t *rings[] = { &xsk->fill, &xsk->comp, &xsk->rx, &xsk->tx };
+    for (uint32_t i = 0; i < sizeof(rings) / sizeof(rings[0]); i++) {
+        if (rings[i]->map) {
+            munmap(rings[i]->map, rings[i]->map_size);
+        }
+    }
+
+    /* The socket is gone; its segments are ours again */
+    if (xsk->slot_state) {
+        for (uint32_t i = 0; i < xsk->region.slot_count; i++) {
+            if (xsk->slot_state[i] != ETH_HOST_SLOT_FREE) {
+                packet_buffer_free((packet_buffer_t *)(xsk->region.base +
+                                                       (size_t)i * xsk->region.slot_size));
+            }
+        }
+        free(xsk->slot_state);
+    }
+}
+
+static status_t eth_xsk_open(eth_host_port_t *port) {
+    eth_xsk_t *xsk = &port->u.xsk;
+    status_t status;
+
+    memset(xsk, 0, sizeof(*xsk));
+    xsk->map_fd = -1;
+    xsk->prog_fd = -1;
+    xsk->link_fd = -1;
+
+    status = packet_get_segment_region(&xsk->region);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    if (port->max_frame + XDP_PACKET_HEADROOM > xsk->region.data_size) {
+        LOG_WARNING(LOG_CATEGORY_DRIVER, "%s: %u-byte frames do not fit a %u-byte segment",
+                    port->ifname, port->max_frame, xsk->region.data_size - XDP_PACKET_HEADROOM);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    xsk->slot_state = (uint8_t *)calloc(xsk->region.slot_count, sizeof(uint8_t));
+    if (!xsk->slot_state) {
+        return STATUS_NO_MEMORY;
+    }
+
+    port->fd = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if (port->fd < 0) {
+        LOG_WARNING(LOG_CATEGORY_DRIVER, "%s: no AF_XDP sockets: %s", port->ifname, strerror(errno));
+        return STATUS_FAILURE;
+    }
+
+    struct xdp_umem_reg umem;
+    memset(&umem, 0, sizeof(umem));
+    umem.addr = (uint64_t)(uintptr_t)xsk->region.base;
+    umem.len = xsk->region.size;
+    umem.chunk_size = xsk->region.data_size;
+    umem.headroom = 0;
+    umem.flags = XDP_UMEM_UNALIGNED_CHUNK_FLAG;
+    if (setsockopt(port->fd, SOL_XDP, XDP_UMEM_REG, &umem, sizeof(umem)) < 0) {
+        LOG_WARNING(LOG_CATEGORY_DRIVER, "%s: cannot register the segment pool: %s",
+                    port->ifname, strerror(errno));
+        return STATUS_FAILURE;
+    }
+
+    int ring_size = (int)port->ring_size;
+    static const int ring_opts[] = { XDP_UMEM_FILL_RING, XDP_UMEM_COMPLETION_RING,
+                                     XDP_RX_RING, XDP_TX_RING };
+    for (uint32_t i = 0; i < sizeof(ring_opts) / sizeof(ring_opts[0]); i++) {
+        if (setsockopt(port->fd, SOL_XDP, ring_opts[i], &ring_size, sizeof(ring_size)) < 0) {
+            LOG_WARNING(LOG_CATEGORY_DRIVER, "%s: cannot size AF_XDP rings: %s", port->ifname, strerror(errno));
+            return STATUS_FAILURE;
+        }
+    }
+
+    struct xdp_mmap_offsets off;
+    socklen_t optlen = sizeof(off);
+    if (getsockopt(port->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0 ||
+        eth_xsk_map_ring(port, &xsk->fill, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) != STATUS_SUCCESS ||
+        eth_xsk_map_ring(port, &xsk->comp, &off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) != STATUS_SUCCESS ||
+        eth_xsk_map_ring(port, &xsk->rx, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) != STATUS_SUCCESS ||
+        eth_xsk_map_ring(port, &xsk->tx, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_DRIVER, "%s: cannot map AF_XDP rings: %s", port->ifname, strerror(errno));
+        return STATUS_FAILURE;
+    }
+
+    /*
+     * Copy mode: the kernel copies between the device and the registered
+     * segments, which works on every driver (veth and tap have no
+     * zero-copy support). The frames still reach packet buffers uncopied.
+     */
+    struct sockaddr_xdp sxdp;
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = (uint32_t)port->ifindex;
+    sxdp.sxdp_queue_id = port->queue_id;
+    sxdp.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+    if (bind(port->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) < 0) {
+        LOG_WARNING(LOG_CATEGORY_DRIVER, "%s: cannot bind AF_XDP socket to queue %u: %s",
+                    port->ifname, port->queue_id, strerror(errno));
+        return STATUS_FAILURE;
+    }
+
+    eth_xsk_refill(port);
+    if (xsk->fill_posted == 0) {
+        return STATUS_NO_MEMORY;
+    }
+
+    return eth_xsk_attach(port);
+}
+
+/* ------------------------------------------------------------------------ */
+/* PACKET_MMAP                                                              */
+/* ------------------------------------------------------------------------ */
+
+static void eth_tp_close(eth_host_port_t *port) {
+    eth_tpacket_t *tp = &port->u.tp;
+
+    if (tp->map) {
+        munmap(tp->map, tp->map_size);
+    }
+    if (port->fd >= 0) {
+        close(port->fd);
+        port->fd = -1;
+    }
+}
+
+static status_t eth_tp_open(eth_host_port_t *port, bool promiscuous) {
+    eth_tpacket_t *tp = &port->u.tp;
+    int one = 1;
+    int version = TPACKET_V3;
+
+    memset(tp, 0, sizeof(*tp));
+
+    port->fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, htons(ETH_P_ALL));
+    if (port->fd < 0) {
+        LOG_ERROR(LOG_CATEGORY_DRIVER, "%s: cannot open packet socket: %s", port->ifname, strerror(errno));
+        return STATUS_FAILURE;
+    }
+
+    if (setsockopt(port->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        LOG_ERROR(LOG_CATEGORY_DRIVER, "%s: no TPACKET_V3: %s", port->ifname, strerror(errno));
+        return STATUS_FAILURE;
+    }
+
+    /* Our own transmissions are not received; malformed TX frames are dropped */
+    setsockopt(port->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+    setsockopt(port->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+    setsockopt(port->fd, SOL_PACKET, PACKET_LOSS, &one, sizeof(one));
+
+    /* TX frames are a power of two holding the header and the largest frame */
+    tp->tx_frame_size = TPACKET_ALIGNMENT;
+    while (tp->tx_frame_size < ETH_HOST_TP_TX_OFFSET + port->max_frame) {
+        tp->tx_frame_size <<= 1;
+    }
+    uint32_t tx_block_size = tp->tx_frame_size > ETH_HOST_TP_BLOCK_SIZE ?
+                             tp->tx_frame_size : ETH_HOST_TP_BLOCK_SIZE;
+    uint32_t tx_block_nr = (uint32_t)(((uint64_t)port->ring_size * tp->tx_frame_size +
+                                       tx_block_size - 1) / tx_block_size);
+    tp->tx_frame_nr = tx_block_nr * (tx_block_size / tp->tx_frame_size);
+
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = ETH_HOST_TP_BLOCK_SIZE;
+    req.tp_block_nr = ETH_HOST_TP_RX_BLOCKS;
+    req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+    req.tp_frame_nr = req.tp_block_size / req.tp_frame_size * req.tp_block_nr;
+    req.tp_retire_blk_tov = ETH_HOST_TP_RETIRE_MS;
+    if (setsockopt(port->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        LOG_ERROR(LOG_CATEGORY_DRIVER, "%s: cannot set up RX ring: %s", port->ifname, strerror(errno));
+        return STATUS_FAILURE;
+    }
+    tp->rx_block_nr = req.tp_block_nr;
+    size_t rx_size = (size_t)req.tp_block_size * req.tp_block_nr;
+
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = tx_block_size;
+    req.tp_block_nr = tx_block_nr;
+    req.tp_frame_size = tp->tx_frame_size;
+    req.tp_frame_nr = tp->tx_frame_nr;
+    if (setsockopt(port->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+        LOG_ERROR(LOG_CATEGORY_DRIVER, "%s: cannot set up TX ring: %s", port->ifname, strerror(errno));
+        return STATUS_FAILURE;
+    }
+
+    /* One mapping, RX ring first */
+    tp->map_size = rx_size + (size_t)tx_block_size * tx_block_nr;
+    tp->map = (uint8_t *)mmap(NULL, tp->map_size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, port->fd, 0);
+    if (tp->map == MAP_FAILED) {
+        tp->map = NULL;
+        LOG_ERROR(LOG_CATEGORY_DRIVER, "%s: cannot map packet rings: %s", port->ifname, strerror(errno));
+        return STATUS_FAILURE;
+    }
+    tp->rx_ring = tp->map;
+    tp->tx_ring = tp->map + rx_size;
+
+    struct sockaddr_ll sll;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = port->ifindex;
+    if (bind(port->fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+        LOG_ERROR(LOG_CATEGORY_DRIVER, "%s: cannot bind packet socket: %s", port->ifname, strerror(errno));
+        return STATUS_FAILURE;
+    }
+
+    if (promiscuous) {
+        struct packet_mreq mreq;
+        memset(&mreq, 0, sizeof(mreq));
+        mreq.mr_ifindex = port->ifindex;
+        mreq.mr_type = PACKET_MR_PROMISC;
+        setsockopt(port->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Copy one received frame into a packet buffer
+ *
+ * The kernel takes VLAN tags off into the header; they are put back.
+ */
+static packet_buffer_t *eth_tp_copy_in(eth_host_port_t *port, const struct tpacket3_hdr *hdr) {
+    const uint8_t *frame = (const uint8_t *)hdr + hdr->tp_mac;
+    uint32_t length = hdr->tp_snaplen;
+    bool tagged = (hdr->tp_status & TP_STATUS_VLAN_VALID) && length >= 2 * ETH_ALEN;
+    uint32_t total = length + (tagged ? 4 : 0);
+    packet_buffer_t *packet = total <= CONFIG_PACKET_SEGMENT_SIZE ?
+                              packet_segment_alloc() : packet_buffer_alloc(total);
+
+    if (!packet) {
+        port->stats.no_buffer++;
+        return NULL;
+    }
+
+    if (tagged) {
+        uint16_t tpid = (hdr->tp_status & TP_STATUS_VLAN_TPID_VALID) ?
+                        hdr->hv1.tp_vlan_tpid : ETH_P_8021Q;
+        uint16_t tag[2] = { htons(tpid), htons((uint16_t)hdr->hv1.tp_vlan_tci) };
+        memcpy(packet->data, frame, 2 * ETH_ALEN);
+        memcpy(packet->data + 2 * ETH_ALEN, tag, sizeof(tag));
+        memcpy(packet->data + 2 * ETH_ALEN + sizeof(tag), frame + 2 * ETH_ALEN,
+               length - 2 * ETH_ALEN);
+    } else {
+        memcpy(packet->data, frame, length);
+    }
+    packet->length = total;
+    return packet;
+}
+
+static uint32_t eth_tp_rx_burst(eth_host_port_t *port, packet_buffer_t **pkts, uint32_t max) {
+    eth_tpacket_t *tp = &port->u.tp;
+    uint32_t n = 0;
+
+    while (n < max) {
+        struct tpacket_block_desc *block =
+            (struct tpacket_block_desc *)(tp->rx_ring + (size_t)tp->rx_block * ETH_HOST_TP_BLOCK_SIZE);
+
+        if (!tp->rx_next) {
+            if (!(eth_load_acquire(&block->hdr.bh1.block_status) & TP_STATUS_USER)) {
+                break;
+            }
+            tp->rx_left = block->hdr.bh1.num_pkts;
+            tp->rx_next = (struct tpacket3_hdr *)((uint8_t *)block + block->hdr.bh1.offset_to_first_pkt);
+        }
+
+        while (tp->rx_left > 0 && n < max) {
+            struct tpacket3_hdr *hdr = tp->rx_next;
+            const struct sockaddr_ll *sll =
+                (const struct sockaddr_ll *)((const uint8_t *)hdr + ETH_HOST_TP_TX_OFFSET);
+
+            if (sll->sll_pkttype != PACKET_OUTGOING) {
+                packet_buffer_t *packet = eth_tp_copy_in(port, hdr);
+                if (packet) {
+                    port->stats.rx_packets++;
+                    port->stats.rx_bytes += packet->length;
+                    pkts[n++] = packet;
+                }
+            }
+            tp->rx_next = (struct tpacket3_hdr *)((uint8_t *)hdr + hdr->tp_next_offset);
+            tp->rx_left--;
+        }
+
+        if (tp->rx_left > 0) {
+            break;
+        }
+
+        /* Block read: hand it back */
+        eth_store_release(&block->hdr.bh1.block_status, TP_STATUS_KERNEL);
+        tp->rx_next = NULL;
+        tp->rx_block = (tp->rx_block + 1) % tp->rx_block_nr;
+    }
+    return n;
+}
+
+/**
+ * @brief Next free TX frame, NULL if the ring is full
+ */
+static inline struct tpacket3_hdr *eth_tp_tx_frame(eth_tpacket_t *tp) {
+    struct tpacket3_hdr *hdr =
+        (struct tpacket3_hdr *)(tp->tx_ring + (size_t)tp->tx_head * tp->tx_frame_size);
+    return eth_load_acquire(&hdr->tp_status) == TP_STATUS_AVAILABLE ? hdr : NULL;
+}
+
+static void eth_tp_post(eth_host_port_t *port, struct tpacket3_hdr *hdr,
+                        const packet_buffer_t *packet, uint32_t length) {
+    eth_tpacket_t *tp = &port->u.tp;
+
+    packet_copy_data(packet, 0, (uint8_t *)hdr + ETH_HOST_TP_TX_OFFSET, length);
+    hdr->tp_len = length;
+    hdr->tp_snaplen = length;
+    hdr->tp_next_offset = 0;
+    eth_store_release(&hdr->tp_status, TP_STATUS_SEND_REQUEST);
+    tp->tx_head = (tp->tx_head + 1) % tp->tx_frame_nr;
+    port->stats.tx_packets++;
+    port->stats.tx_bytes += length;
+    port->stats.tx_copied++;
+}
+
+static void eth_tp_kick(eth_host_port_t *port) {
+    port->stats.tx_kicks++;
+    sendto(port->fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+}
+
+static uint32_t eth_tp_tx_burst(eth_host_port_t *port, packet_buffer_t **pkts, uint32_t count) {
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        uint32_t length = packet_chain_length(pkts[i]);
+
+        if (length > port->max_frame) {
+            port->stats.tx_dropped++;
+        } else {
+            struct tpacket3_hdr *hdr = eth_tp_tx_frame(&port->u.tp);
+            if (!hdr) {
+                port->stats.tx_ring_full++;
+                break;
+            }
+            eth_tp_post(port, hdr, pkts[i], length);
+        }
+        packet_buffer_free(pkts[i]);
+    }
+
+    if (i > 0) {
+        eth_tp_kick(port);
+    }
+    return i;
+}
+
+static status_t eth_tp_tx_copy(eth_host_port_t *port, const packet_buffer_t *packet) {
+    uint32_t length = packet_chain_length(packet);
+
+    if (length > port->max_frame) {
+        port->stats.tx_dropped++;
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    struct tpacket3_hdr *hdr = eth_tp_tx_frame(&port->u.tp);
+    if (!hdr) {
+        port->stats.tx_ring_full++;
+        return STATUS_RESOURCE_BUSY;
+    }
+    eth_tp_post(port, hdr, packet, length);
+    eth_tp_kick(port);
+    return STATUS_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Public interface                                                         */
+/* ------------------------------------------------------------------------ */
+
+status_t eth_host_open(const eth_host_config_t *config, eth_host_port_t **port_out) {
+    if (!config || !config->ifname || !port_out ||
+        strlen(config->ifname) >= ETH_HOST_IFNAME_LEN ||
+        (config->ring_size & (config->ring_size - 1)) != 0 ||
+        config->ring_size > ETH_HOST_MAX_RING_SIZE) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    int ifindex = (int)if_nametoindex(config->ifname);
+    if (ifindex == 0) {
+        LOG_ERROR(LOG_CATEGORY_DRIVER, "No host interface %s", config->ifname);
+        return STATUS_NOT_FOUND;
+    }
+
+    eth_host_port_t *port = (eth_host_port_t *)calloc(1, sizeof(eth_host_port_t));
+    if (!port) {
+        return STATUS_NO_MEMORY;
+    }
+    strcpy(port->ifname, config->ifname);
+    port->fd = -1;
+    port->ifindex = ifindex;
+    port->queue_id = config->queue_id;
+    port->ring_size = config->ring_size ? config->ring_size : ETH_HOST_DEFAULT_RING_SIZE;
+    port->max_frame = (config->mtu ? config->mtu : ETH_HOST_DEFAULT_MTU) + ETH_HOST_L2_OVERHEAD;
+    port->backend = config->backend;
+
+    status_t status = STATUS_FAILURE;
+    if (port->backend == ETH_HOST_AF_XDP) {
+        status = eth_xsk_open(port);
+        if (status != STATUS_SUCCESS) {
+            eth_xsk_close(port);
+            if (status == STATUS_NOT_INITIALIZED) {
+                free(port);
+                return status;
+            }
+            LOG_WARNING(LOG_CATEGORY_DRIVER, "%s: AF_XDP unavailable, using PACKET_MMAP",
+                        port->ifname);
+            memset(&port->u, 0, sizeof(port->u));
+            port->backend = ETH_HOST_PACKET_MMAP;
+        }
+    }
+    if (port->backend == ETH_HOST_PACKET_MMAP) {
+        status = eth_tp_open(port, config->promiscuous);
+        if (status != STATUS_SUCCESS) {
+            eth_tp_close(port);
+            free(port);
+            return status;
+        }
+    }
+
+    LOG_INFO(LOG_CATEGORY_DRIVER, "Host port %s opened (%s, %u descriptors)", port->ifname,
+             port->backend == ETH_HOST_AF_XDP ? "AF_XDP" : "PACKET_MMAP", port->ring_size);
+    *port_out = port;
+    return STATUS_SUCCESS;
+}
+
+void eth_host_close(eth_host_port_t *port) {
+    if (!port) {
+        return;
+    }
+
+    if (port->backend == ETH_HOST_AF_XDP) {
+        eth_xsk_close(port);
+    } else {
+        eth_tp_close(port);
+    }
+    LOG_INFO(LOG_CATEGORY_DRIVER, "Host port %s closed", port->ifname);
+    free(port);
+}
+
+eth_host_backend_t eth_host_get_backend(const eth_host_port_t *port) {
+    return port->backend;
+}
+
+uint32_t eth_host_rx_burst(eth_host_port_t *port, packet_buffer_t **pkts, uint32_t max) {
+    if (!port || !pkts) {
+        return 0;
+    }
+    return port->backend == ETH_HOST_AF_XDP ? eth_xsk_rx_burst(port, pkts, max) :
+                                              eth_tp_rx_burst(port, pkts, max);
+}
+
+bool eth_host_wait(eth_host_port_t *port, int timeout_ms) {
+    struct pollfd pfd = { .fd = port->fd, .events = POLLIN };
+    return poll(&pfd, 1, timeout_ms) > 0 && (pfd.revents & POLLIN);
+}
+
+uint32_t eth_host_tx_burst(eth_host_port_t *port, packet_buffer_t **pkts, uint32_t count) {
+    if (!port || !pkts || count == 0) {
+        return 0;
+    }
+    return port->backend == ETH_HOST_AF_XDP ? eth_xsk_tx_burst(port, pkts, count) :
+                                              eth_tp_tx_burst(port, pkts, count);
+}
+
+status_t eth_host_tx_copy(eth_host_port_t *port, const packet_buffer_t *packet) {
+    if (!port || !packet) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    return port->backend == ETH_HOST_AF_XDP ? eth_xsk_tx_copy(port, packet) :
+                                              eth_tp_tx_copy(port, packet);
+}
+
+void eth_host_get_stats(const eth_host_port_t *port, eth_host_stats_t *stats) {
+    if (port && stats) {
+        *stats = port->stats;
+    }
+}
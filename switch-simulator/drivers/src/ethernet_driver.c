@@ -17,13 +17,38 @@
 #include <unistd.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <time.h>
 
 #include "drivers/include/ethernet_driver.h"
 #include "common/logging.h"
 #include "common/utils.h"
 #include "drivers/include/sim_driver.h"
+#include "drivers/include/eth_host_io.h"
+#include "hal/hw_simulation.h"
+#include "hal/packet_ring.h"
 #include "hal/hw_resources.h"
+#include "hal/link_event.h"
 #include "common/threading.h"
+#include "common/stats_shard.h"
+
+#define ETH_MAC_FILTER_VALID          (1ULL << 63)
+#define ETH_VLAN_FILTER_WORDS         (4096 / 64)
+
+/**
+ * @brief Receive filters of a port
+ *
+ * The receive path reads them without the port lock, before a frame is
+ * counted or handed on. Writers hold the port lock and change one word at a
+ * time, so a frame racing a change is judged by the old or the new filter.
+ */
+typedef struct {
+    uint64_t macs[ETH_MAC_FILTER_BUCKETS][ETH_MAC_FILTER_WAYS]; /**< Address | ETH_MAC_FILTER_VALID, 0 if free */
+    uint64_t vlans[ETH_VLAN_FILTER_WORDS];  /**< VLAN IDs let through */
+    uint64_t own_mac;                 /**< Port address | ETH_MAC_FILTER_VALID, always let through */
+    uint32_t mac_count;               /**< Addresses in macs */
+    uint32_t vlan_count;              /**< VLAN IDs in vlans, 0 to pass every tag */
+    bool mac_enforced;                /**< Addresses set and the port is not promiscuous */
+} eth_rx_filter_t;
 
 /**
  * @brief Internal port state structure
@@ -32,12 +57,25 @@ typedef struct {
     bool is_open;                     /**< Port is open and initialized */
     eth_port_config_t config;         /**< Current port configuration */
     eth_port_status_t status;         /**< Current port status */
-    eth_port_stats_t stats;           /**< Port statistics */
     eth_rx_callback_t rx_callback;    /**< RX callback function */
     void *rx_user_data;               /**< User data for RX callback */
     pthread_mutex_t lock;             /**< Port state lock */
+    eth_host_port_t *host;            /**< Host interface backend, NULL for simulated ports */
+    pthread_t rx_thread;              /**< Receive thread of a host port */
+    bool rx_running;                  /**< Receive thread keeps polling */
+    packet_ring_t *rx_ring;           /**< Poll mode: frames for eth_port_rx_burst(), NULL otherwise */
+    eth_rx_coalesce_t coalesce;       /**< Poll mode: wakeup coalescing */
+    uint64_t rx_pending_since_us;     /**< Poll mode: when the ring last became non-empty */
+    uint32_t rx_waiters;              /**< Poll mode: threads in eth_port_rx_wait() */
+    pthread_cond_t rx_cond;           /**< Poll mode: signalled on port->lock when frames are ready */
+    eth_rx_filter_t filter;           /**< MAC and VLAN receive filters */
 } eth_port_state_t;
 
+/**
+ * @brief Longest wait of a host port's receive thread between checks for stop
+ */
+#define ETH_HOST_RX_WAIT_MS            10
+
 /**
  * @brief Global Ethernet driver state
  */
@@ -45,17 +83,49 @@ typedef struct {
     bool initialized;                       /**< Driver initialization state */
     eth_port_state_t ports[ETH_MAX_PORTS];  /**< Port state array */
     pthread_mutex_t global_lock;            /**< Global driver lock */
+    stats_shard_set_t *stats;               /**< eth_port_stats_t of every port, per thread */
 } eth_driver_state_t;
 
 /* Global driver state */
 static eth_driver_state_t g_eth_driver = {0};
 
+#define ETH_STATS_WORDS (sizeof(eth_port_stats_t) / sizeof(uint64_t))
+
+/**
+ * @brief Statistics of a port on the calling thread; counting takes no lock
+ */
+static inline eth_port_stats_t *eth_port_counters(const eth_port_state_t *port) {
+    return (eth_port_stats_t *)stats_shard_local(g_eth_driver.stats) + (port - g_eth_driver.ports);
+}
+
+/**
+ * @brief Filter key of a MAC address
+ */
+static inline uint64_t eth_mac_key(const uint8_t mac[6]) {
+    return ETH_MAC_FILTER_VALID | ((uint64_t)mac[0] << 40) | ((uint64_t)mac[1] << 32) |
+           ((uint64_t)mac[2] << 24) | ((uint64_t)mac[3] << 16) | ((uint64_t)mac[4] << 8) | mac[5];
+}
+
+/**
+ * @brief Bucket of a filter key
+ */
+static inline uint32_t eth_mac_bucket(uint64_t key) {
+    return (uint32_t)(((key & ~ETH_MAC_FILTER_VALID) * 0x9E3779B97F4A7C15ULL) >> 32) % ETH_MAC_FILTER_BUCKETS;
+}
+
 /* Forward declarations of internal functions */
 static void eth_port_init_state(eth_port_state_t *port);
 static bool eth_validate_config(const eth_port_config_t *config);
 static void eth_update_link_speed(uint16_t port_id);
 static status_t eth_handle_received_packet(uint16_t port_id, const packet_t *packet);
 static void eth_simulate_packet_processing(const packet_t *packet, eth_port_stats_t *stats);
+static status_t eth_host_port_start(uint16_t port_id, eth_port_state_t *port);
+static void eth_host_port_stop(eth_port_state_t *port);
+static void eth_rx_count(eth_port_state_t *port, const packet_t *packet);
+static uint32_t eth_rx_ring_push(eth_port_state_t *port, packet_t **pkts, uint32_t count);
+static void eth_rx_ring_release(eth_port_state_t *port);
+static void eth_rx_filter_refresh(eth_port_state_t *port);
+static bool eth_rx_filter_pass(eth_port_state_t *port, const packet_t *packet);
 
 /**
  * @brief Initialize Ethernet driver subsystem
@@ -81,10 +151,19 @@ status_t eth_driver_init(void) {
         eth_port_init_state(&g_eth_driver.ports[i]);
     }
 
+    status_t status = stats_shard_create(ETH_MAX_PORTS * ETH_STATS_WORDS, &g_eth_driver.stats);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR("Failed to allocate port statistics: %d", status);
+        pthread_mutex_destroy(&g_eth_driver.global_lock);
+        return status;
+    }
+
     /* Initialize hardware simulation backend */
-    status_t status = sim_driver_init();
+    status = sim_driver_init();
     if (status != STATUS_SUCCESS) {
         LOG_ERROR("Failed to initialize simulation driver: %d", status);
+        stats_shard_destroy(g_eth_driver.stats);
+        g_eth_driver.stats = NULL;
         pthread_mutex_destroy(&g_eth_driver.global_lock);
         return status;
     }
@@ -120,6 +199,8 @@ status_t eth_driver_shutdown(void) {
     /* Shutdown hardware simulation backend */
     sim_driver_shutdown();
 
+    stats_shard_destroy(g_eth_driver.stats);
+    g_eth_driver.stats = NULL;
     g_eth_driver.initialized = false;
     pthread_mutex_unlock(&g_eth_driver.global_lock);
     pthread_mutex_destroy(&g_eth_driver.global_lock);
@@ -172,8 +253,10 @@ status_t eth_port_open(uint16_t port_id, const eth_port_config_t *config) {
     }
 
     /* Initialize port state */
-    memset(&port->stats, 0, sizeof(eth_port_stats_t));
+    stats_shard_clear(g_eth_driver.stats, port_id * ETH_STATS_WORDS, ETH_STATS_WORDS);
     memcpy(&port->config, config, sizeof(eth_port_config_t));
+    memset(&port->filter, 0, sizeof(port->filter));
+    eth_rx_filter_refresh(port);
     
     /* Initialize status */
     port->status.flags = ETH_STATUS_ADMIN_UP;
@@ -195,6 +278,18 @@ status_t eth_port_open(uint16_t port_id, const eth_port_config_t *config) {
     /* Simulate link negotiation */
     eth_update_link_speed(port_id);
     
+    /* Attach the host interface and start receiving from it */
+    if (config->backend != ETH_BACKEND_SIM) {
+        status = eth_host_port_start(port_id, port);
+        if (status != STATUS_SUCCESS) {
+            LOG_ERROR("Failed to attach port %u to host interface %s: %d",
+                      port_id, config->host_ifname, status);
+            sim_driver_port_shutdown(port_id);
+            pthread_mutex_unlock(&port->lock);
+            return status;
+        }
+    }
+
     /* Mark port as open */
     port->is_open = true;
     
@@ -235,6 +330,14 @@ status_t eth_port_close(uint16_t port_id) {
         return STATUS_NOT_FOUND;
     }
 
+    /* The receive thread takes the port lock, so it is stopped unlocked */
+    if (port->host) {
+        port->is_open = false;
+        pthread_mutex_unlock(&port->lock);
+        eth_host_port_stop(port);
+        pthread_mutex_lock(&port->lock);
+    }
+
     /* Shutdown simulation for this port */
     status_t status = sim_driver_port_shutdown(port_id);
     if (status != STATUS_SUCCESS) {
@@ -243,6 +346,7 @@ status_t eth_port_close(uint16_t port_id) {
     }
 
     /* Clear port state */
+    eth_rx_ring_release(port);
     port->is_open = false;
     port->rx_callback = NULL;
     port->rx_user_data = NULL;
@@ -346,6 +450,9 @@ status_t eth_port_configure(uint16_t port_id, const eth_port_config_t *config) {
         eth_update_link_speed(port_id);
     }
 
+    /* The address and promiscuous mode decide what the MAC filter lets through */
+    eth_rx_filter_refresh(port);
+
     pthread_mutex_unlock(&port->lock);
     LOG_INFO("Port %u configured successfully", port_id);
     
@@ -533,10 +640,10 @@ status_t eth_port_get_stats(uint16_t port_id, eth_port_stats_t *stats) {
         return STATUS_NOT_FOUND;
     }
 
-    /* Copy statistics */
-    memcpy(stats, &port->stats, sizeof(eth_port_stats_t));
-    
     pthread_mutex_unlock(&port->lock);
+
+    /* Fold the counts of every thread */
+    stats_shard_fold(g_eth_driver.stats, port_id * ETH_STATS_WORDS, ETH_STATS_WORDS, (uint64_t *)stats);
     return STATUS_SUCCESS;
 }
 
@@ -572,7 +679,7 @@ status_t eth_port_clear_stats(uint16_t port_id) {
     }
 
     /* Clear statistics */
-    memset(&port->stats, 0, sizeof(eth_port_stats_t));
+    stats_shard_clear(g_eth_driver.stats, port_id * ETH_STATS_WORDS, ETH_STATS_WORDS);
     
     pthread_mutex_unlock(&port->lock);
     LOG_INFO("Statistics cleared for port %u", port_id);
@@ -674,11 +781,13 @@ status_t eth_port_unregister_rx_callback(uint16_t port_id) {
     port->rx_callback = NULL;
     port->rx_user_data = NULL;
     
-    /* Unregister with simulation driver */
-    status_t status = sim_driver_unregister_rx_handler(port_id);
-    if (status != STATUS_SUCCESS) {
-        LOG_ERROR("Failed to unregister RX handler with simulation driver: %d", status);
-        /* Continue anyway */
+    /* Unregister with simulation driver, which still feeds a poll-mode port */
+    if (port->rx_ring == NULL) {
+        status_t status = sim_driver_unregister_rx_handler(port_id);
+        if (status != STATUS_SUCCESS) {
+            LOG_ERROR("Failed to unregister RX handler with simulation driver: %d", status);
+            /* Continue anyway */
+        }
     }
     
     pthread_mutex_unlock(&port->lock);
@@ -687,6 +796,50 @@ status_t eth_port_unregister_rx_callback(uint16_t port_id) {
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Count and send one packet; called with the port lock held
+ *
+ * @param port_id Port identifier
+ * @param port Port state
+ * @param packet Packet to transmit
+ *
+ * @return STATUS_SUCCESS on success, error code otherwise
+ */
+static status_t eth_port_tx_locked(uint16_t port_id, eth_port_state_t *port, const packet_t *packet) {
+    eth_port_stats_t *stats = eth_port_counters(port);
+
+    /* Update TX statistics */
+    stats_shard_add(&stats->tx_packets, 1);
+    stats_shard_add(&stats->tx_bytes, packet->length);
+    
+    /* Check packet type for more detailed statistics */
+    const uint8_t *dst_mac = packet->data;
+    if (dst_mac[0] & 0x01) {
+        /* Multicast/broadcast packet */
+        if (dst_mac[0] == 0xFF && dst_mac[1] == 0xFF && dst_mac[2] == 0xFF &&
+            dst_mac[3] == 0xFF && dst_mac[4] == 0xFF && dst_mac[5] == 0xFF) {
+            stats_shard_add(&stats->tx_broadcast, 1);
+        } else {
+            stats_shard_add(&stats->tx_multicast, 1);
+        }
+    } else {
+        /* Unicast packet */
+        stats_shard_add(&stats->tx_unicast, 1);
+    }
+
+    /* Simulate packet processing */
+    eth_simulate_packet_processing(packet, stats);
+
+    /* Forward to the host interface or the simulation driver */
+    status_t status = port->host ? eth_host_tx_copy(port->host, packet) :
+                                   sim_driver_tx_packet(port_id, packet);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR("Failed to transmit packet on port %u: %d", port_id, status);
+        stats_shard_add(&stats->tx_errors, 1);
+    }
+    return status;
+}
+
 /**
  * @brief Transmit a packet on a port
  *
@@ -737,33 +890,8 @@ status_t eth_port_tx_packet(uint16_t port_id, const packet_t *packet) {
         return STATUS_NOT_READY;
     }
 
-    /* Update TX statistics */
-    port->stats.tx_packets++;
-    port->stats.tx_bytes += packet->length;
-    
-    /* Check packet type for more detailed statistics */
-    const uint8_t *dst_mac = packet->data;
-    if (dst_mac[0] & 0x01) {
-        /* Multicast/broadcast packet */
-        if (dst_mac[0] == 0xFF && dst_mac[1] == 0xFF && dst_mac[2] == 0xFF &&
-            dst_mac[3] == 0xFF && dst_mac[4] == 0xFF && dst_mac[5] == 0xFF) {
-            port->stats.tx_broadcast++;
-        } else {
-            port->stats.tx_multicast++;
-        }
-    } else {
-        /* Unicast packet */
-        port->stats.tx_unicast++;
-    }
-
-    /* Simulate packet processing */
-    eth_simulate_packet_processing(packet, &port->stats);
-
-    /* Forward to simulation driver */
-    status_t status = sim_driver_tx_packet(port_id, packet);
+    status_t status = eth_port_tx_locked(port_id, port, packet);
     if (status != STATUS_SUCCESS) {
-        LOG_ERROR("Failed to transmit packet on port %u: %d", port_id, status);
-        port->stats.tx_errors++;
         pthread_mutex_unlock(&port->lock);
         return status;
     }
@@ -778,6 +906,63 @@ status_t eth_port_tx_packet(uint16_t port_id, const packet_t *packet) {
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Transmit a burst of packets on a port, handing them over
+ *
+ * @param port_id Port identifier
+ * @param pkts Packets to transmit
+ * @param count Number of packets
+ *
+ * @return Number of packets accepted (a prefix of pkts)
+ */
+uint32_t eth_port_tx_burst(uint16_t port_id, packet_t **pkts, uint32_t count) {
+    if (!g_eth_driver.initialized || port_id >= ETH_MAX_PORTS || pkts == NULL || count == 0) {
+        return 0;
+    }
+
+    eth_port_state_t *port = &g_eth_driver.ports[port_id];
+    pthread_mutex_lock(&port->lock);
+
+    if (!port->is_open || !(port->status.flags & ETH_STATUS_ADMIN_UP) || !port->status.link_up) {
+        pthread_mutex_unlock(&port->lock);
+        return 0;
+    }
+
+    /* Simulated ports send the packets one by one under a single lock */
+    if (!port->host) {
+        uint32_t sent = 0;
+        while (sent < count && pkts[sent]->length >= ETH_MIN_FRAME_SIZE &&
+               pkts[sent]->length <= ETH_MAX_FRAME_SIZE &&
+               eth_port_tx_locked(port_id, port, pkts[sent]) == STATUS_SUCCESS) {
+            sent++;
+        }
+        bool loopback = (port->status.flags & ETH_STATUS_LOOPBACK) != 0;
+        pthread_mutex_unlock(&port->lock);
+
+        for (uint32_t i = 0; i < sent; i++) {
+            if (loopback) {
+                eth_handle_received_packet(port_id, pkts[i]);
+            }
+            packet_buffer_free(pkts[i]);
+        }
+        return sent;
+    }
+
+    /* The backend counts what it sent; the port takes the difference */
+    eth_host_stats_t before, after;
+    eth_host_get_stats(port->host, &before);
+    uint32_t accepted = eth_host_tx_burst(port->host, pkts, count);
+    eth_host_get_stats(port->host, &after);
+
+    eth_port_stats_t *stats = eth_port_counters(port);
+    stats_shard_add(&stats->tx_packets, after.tx_packets - before.tx_packets);
+    stats_shard_add(&stats->tx_bytes, after.tx_bytes - before.tx_bytes);
+    stats_shard_add(&stats->tx_dropped, after.tx_dropped - before.tx_dropped);
+
+    pthread_mutex_unlock(&port->lock);
+    return accepted;
+}
+
 /**
  * @brief Set MAC address filtering for a port
  *
@@ -817,6 +1002,25 @@ status_t eth_port_set_mac_filter(uint16_t port_id, const uint8_t mac_addr[6], bo
         return STATUS_NOT_FOUND;
     }
 
+    /* Find the address's slot, or a free one for a new address */
+    uint64_t key = eth_mac_key(mac_addr);
+    uint64_t *bucket = port->filter.macs[eth_mac_bucket(key)];
+    uint64_t *slot = NULL;
+    for (uint32_t way = 0; way < ETH_MAC_FILTER_WAYS; way++) {
+        if (bucket[way] == key) {
+            slot = &bucket[way];
+            break;
+        }
+        if (add && bucket[way] == 0 && slot == NULL) {
+            slot = &bucket[way];
+        }
+    }
+    if (add && slot == NULL) {
+        LOG_ERROR("MAC filter of port %u is full for this address", port_id);
+        pthread_mutex_unlock(&port->lock);
+        return STATUS_RESOURCE_EXHAUSTED;
+    }
+
     /* Forward to simulation driver */
     status_t status = sim_driver_set_mac_filter(port_id, mac_addr, add);
     if (status != STATUS_SUCCESS) {
@@ -824,6 +1028,16 @@ status_t eth_port_set_mac_filter(uint16_t port_id, const uint8_t mac_addr[6], bo
         pthread_mutex_unlock(&port->lock);
         return status;
     }
+
+    /* Enforce it in the receive path */
+    if (add && *slot != key) {
+        __atomic_store_n(slot, key, __ATOMIC_RELEASE);
+        port->filter.mac_count++;
+    } else if (!add && slot != NULL) {
+        __atomic_store_n(slot, 0, __ATOMIC_RELEASE);
+        port->filter.mac_count--;
+    }
+    eth_rx_filter_refresh(port);
     
     pthread_mutex_unlock(&port->lock);
     LOG_INFO("MAC filter %s for port %u: %02x:%02x:%02x:%02x:%02x:%02x",
@@ -873,11 +1087,6 @@ status_t eth_port_set_vlan_filter(uint16_t port_id, uint16_t vlan_id, bool add)
         return STATUS_NOT_FOUND;
     }
 
-    /* Update VLAN filtering flag */
-    if (add) {
-        port->status.flags |= ETH_STATUS_VLAN_FILTERING;
-    }
-
     /* Forward to simulation driver */
     status_t status = sim_driver_set_vlan_filter(port_id, vlan_id, add);
     if (status != STATUS_SUCCESS) {
@@ -885,6 +1094,22 @@ status_t eth_port_set_vlan_filter(uint16_t port_id, uint16_t vlan_id, bool add)
         pthread_mutex_unlock(&port->lock);
         return status;
     }
+
+    /* Enforce it in the receive path; the filter is on while it holds a VLAN */
+    uint64_t *word = &port->filter.vlans[vlan_id / 64];
+    uint64_t bit = 1ULL << (vlan_id % 64);
+    if (add && !(*word & bit)) {
+        __atomic_or_fetch(word, bit, __ATOMIC_RELEASE);
+        __atomic_store_n(&port->filter.vlan_count, port->filter.vlan_count + 1, __ATOMIC_RELEASE);
+    } else if (!add && (*word & bit)) {
+        __atomic_store_n(&port->filter.vlan_count, port->filter.vlan_count - 1, __ATOMIC_RELEASE);
+        __atomic_and_fetch(word, ~bit, __ATOMIC_RELEASE);
+    }
+    if (port->filter.vlan_count > 0) {
+        port->status.flags |= ETH_STATUS_VLAN_FILTERING;
+    } else {
+        port->status.flags &= ~ETH_STATUS_VLAN_FILTERING;
+    }
     
     pthread_mutex_unlock(&port->lock);
     LOG_INFO("VLAN filter %s for port %u: VLAN %u",
@@ -1142,6 +1367,539 @@ status_t eth_port_simulate_link_event(uint16_t port_id, bool link_up) {
     
     pthread_mutex_unlock(&port->lock);
     LOG_INFO("Link %s event simulated for port %u", link_up ? "UP" : "DOWN", port_id);
+
+    /* Upper layers learn of the change through the coalesced link events */
+    link_event_report(port_id, link_up);
     
     return STATUS_SUCCESS;
 }
+
+/**
+ * @brief Recompute what the MAC filter lets through; called with the port lock held
+ *
+ * @param port Port state
+ */
+static void eth_rx_filter_refresh(eth_port_state_t *port) {
+    __atomic_store_n(&port->filter.own_mac, eth_mac_key(port->config.mac_addr), __ATOMIC_RELEASE);
+    __atomic_store_n(&port->filter.mac_enforced,
+                     port->filter.mac_count > 0 && !port->config.promiscuous_mode, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Check a received frame against the port's filters
+ *
+ * A frame the filters drop is counted here; nothing else is looked at, so
+ * it costs neither a copy nor a trip through the pipeline.
+ *
+ * @param port Port state
+ * @param packet Received frame
+ *
+ * @return true if the frame goes on
+ */
+static bool eth_rx_filter_pass(eth_port_state_t *port, const packet_t *packet) {
+    const eth_rx_filter_t *filter = &port->filter;
+    const uint8_t *frame = packet->data;
+
+    /* Runts are left for the pipeline to count */
+    if (packet->length < 14) {
+        return true;
+    }
+
+    if (!(frame[0] & 0x01) && __atomic_load_n(&filter->mac_enforced, __ATOMIC_ACQUIRE)) {
+        uint64_t key = eth_mac_key(frame);
+        bool found = key == __atomic_load_n(&filter->own_mac, __ATOMIC_RELAXED);
+        const uint64_t *bucket = filter->macs[eth_mac_bucket(key)];
+
+        for (uint32_t way = 0; way < ETH_MAC_FILTER_WAYS && !found; way++) {
+            found = __atomic_load_n(&bucket[way], __ATOMIC_RELAXED) == key;
+        }
+        if (!found) {
+            stats_shard_add(&eth_port_counters(port)->rx_mac_filtered, 1);
+            return false;
+        }
+    }
+
+    if (__atomic_load_n(&filter->vlan_count, __ATOMIC_ACQUIRE) > 0 && packet->length >= 18) {
+        uint16_t tpid = (uint16_t)(frame[12] << 8 | frame[13]);
+
+        if (tpid == 0x8100 || tpid == 0x88A8) {
+            uint16_t vid = (uint16_t)((frame[14] << 8 | frame[15]) & 0x0FFF);
+
+            if (vid != 0 && !(__atomic_load_n(&filter->vlans[vid / 64], __ATOMIC_RELAXED) & (1ULL << (vid % 64)))) {
+                stats_shard_add(&eth_port_counters(port)->rx_vlan_filtered, 1);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Count one received frame
+ *
+ * @param port Port state
+ * @param packet Received frame
+ */
+static void eth_rx_count(eth_port_state_t *port, const packet_t *packet) {
+    eth_port_stats_t *stats = eth_port_counters(port);
+    const uint8_t *dst_mac = packet->data;
+
+    stats_shard_add(&stats->rx_packets, 1);
+    stats_shard_add(&stats->rx_bytes, packet->length);
+    if (!(dst_mac[0] & 0x01)) {
+        stats_shard_add(&stats->rx_unicast, 1);
+    } else if (dst_mac[0] == 0xFF && dst_mac[1] == 0xFF && dst_mac[2] == 0xFF &&
+               dst_mac[3] == 0xFF && dst_mac[4] == 0xFF && dst_mac[5] == 0xFF) {
+        stats_shard_add(&stats->rx_broadcast, 1);
+    } else {
+        stats_shard_add(&stats->rx_multicast, 1);
+    }
+}
+
+/**
+ * @brief Hand a burst received on a host port to the poller, the RX callback or the simulator
+ *
+ * @param port_id Port identifier
+ * @param port Port state
+ * @param pkts Received packets, freed or handed over here
+ * @param count Number of packets
+ */
+static void eth_host_deliver(uint16_t port_id, eth_port_state_t *port,
+                             packet_t **pkts, uint32_t count) {
+    /* Filtered frames go back to the pool here, as a NIC would drop them */
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (eth_rx_filter_pass(port, pkts[i])) {
+            eth_rx_count(port, pkts[i]);
+            pkts[kept++] = pkts[i];
+        } else {
+            packet_buffer_free(pkts[i]);
+        }
+    }
+    count = kept;
+    if (count == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&port->lock);
+    eth_rx_callback_t callback = port->rx_callback;
+    void *user_data = port->rx_user_data;
+
+    /* Poll mode: the received buffers themselves go on the ring */
+    if (port->rx_ring) {
+        uint32_t queued = eth_rx_ring_push(port, pkts, count);
+        pthread_mutex_unlock(&port->lock);
+        for (uint32_t i = queued; i < count; i++) {
+            packet_buffer_free(pkts[i]);
+        }
+        return;
+    }
+    pthread_mutex_unlock(&port->lock);
+
+    if (callback) {
+        for (uint32_t i = 0; i < count; i++) {
+            callback(port_id, pkts[i], user_data);
+            packet_buffer_free(pkts[i]);
+        }
+        return;
+    }
+
+    uint32_t queued = hw_sim_rx_enqueue_burst((port_id_t)port_id, pkts, count);
+    if (queued < count) {
+        for (uint32_t i = queued; i < count; i++) {
+            packet_buffer_free(pkts[i]);
+        }
+        stats_shard_add(&eth_port_counters(port)->rx_dropped, count - queued);
+    }
+}
+
+/**
+ * @brief Receive thread of a host port
+ *
+ * @param arg Port identifier
+ */
+static void *eth_host_rx_thread(void *arg) {
+    uint16_t port_id = (uint16_t)(uintptr_t)arg;
+    eth_port_state_t *port = &g_eth_driver.ports[port_id];
+    packet_t *pkts[PACKET_BURST_MAX];
+
+    while (__atomic_load_n(&port->rx_running, __ATOMIC_ACQUIRE)) {
+        uint32_t count = eth_host_rx_burst(port->host, pkts, PACKET_BURST_MAX);
+        if (count == 0) {
+            eth_host_wait(port->host, ETH_HOST_RX_WAIT_MS);
+            continue;
+        }
+        eth_host_deliver(port_id, port, pkts, count);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Open the host interface of a port and start its receive thread
+ *
+ * Called with the port lock held.
+ *
+ * @param port_id Port identifier
+ * @param port Port state, configuration already set
+ *
+ * @return STATUS_SUCCESS on success, error code otherwise
+ */
+static status_t eth_host_port_start(uint16_t port_id, eth_port_state_t *port) {
+    const eth_port_config_t *config = &port->config;
+    char ifname[ETH_HOST_IFNAME_MAX];
+
+    memcpy(ifname, config->host_ifname, sizeof(ifname));
+    ifname[sizeof(ifname) - 1] = '\0';
+
+    eth_host_config_t host_config = {
+        .ifname = ifname,
+        .backend = config->backend == ETH_BACKEND_PACKET_MMAP ? ETH_HOST_PACKET_MMAP : ETH_HOST_AF_XDP,
+        .queue_id = config->host_queue,
+        .ring_size = config->host_ring_size,
+        .mtu = config->mtu,
+        .promiscuous = config->promiscuous_mode,
+    };
+
+    status_t status = eth_host_open(&host_config, &port->host);
+    if (status != STATUS_SUCCESS) {
+        port->host = NULL;
+        return status;
+    }
+
+    __atomic_store_n(&port->rx_running, true, __ATOMIC_RELEASE);
+    if (pthread_create(&port->rx_thread, NULL, eth_host_rx_thread, (void *)(uintptr_t)port_id) != 0) {
+        port->rx_running = false;
+        eth_host_close(port->host);
+        port->host = NULL;
+        return STATUS_RESOURCE_UNAVAILABLE;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Stop the receive thread of a host port and close its interface
+ *
+ * Called without the port lock, which the receive thread takes.
+ *
+ * @param port Port state
+ */
+static void eth_host_port_stop(eth_port_state_t *port) {
+    __atomic_store_n(&port->rx_running, false, __ATOMIC_RELEASE);
+    pthread_join(port->rx_thread, NULL);
+    eth_host_close(port->host);
+    port->host = NULL;
+}
+
+/**
+ * @brief Monotonic time in microseconds
+ */
+static uint64_t eth_now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Whether a poll-mode port's frames are due by its coalescing; called with the port lock held
+ *
+ * @param port Port state, in poll mode
+ * @param now_us Current time
+ */
+static bool eth_rx_ready(const eth_port_state_t *port, uint64_t now_us) {
+    uint32_t queued = packet_ring_count(port->rx_ring);
+    uint32_t max_packets = port->coalesce.max_packets ? port->coalesce.max_packets : 1;
+
+    if (queued == 0) {
+        return false;
+    }
+    if (queued >= max_packets) {
+        return true;
+    }
+    return port->coalesce.max_usecs != 0 &&
+           now_us - port->rx_pending_since_us >= port->coalesce.max_usecs;
+}
+
+/**
+ * @brief Queue received frames for the poller; called with the port lock held
+ *
+ * The port lock serializes producers, so the ring stays single-producer.
+ * Frames that find the ring full are counted as dropped and left to the
+ * caller to free.
+ *
+ * @param port Port state, in poll mode
+ * @param pkts Received frames, handed over up to the returned count
+ * @param count Number of frames
+ *
+ * @return Number of frames queued
+ */
+static uint32_t eth_rx_ring_push(eth_port_state_t *port, packet_t **pkts, uint32_t count) {
+    bool was_empty = packet_ring_count(port->rx_ring) == 0;
+    uint32_t queued = packet_ring_enqueue_burst(port->rx_ring, pkts, count);
+
+    if (queued < count) {
+        stats_shard_add(&eth_port_counters(port)->rx_dropped, count - queued);
+    }
+    if (queued == 0) {
+        return 0;
+    }
+
+    uint64_t now_us = eth_now_us();
+    if (was_empty) {
+        port->rx_pending_since_us = now_us;
+    }
+
+    /* A first frame also wakes a waiter so it can arm the max_usecs deadline */
+    if (port->rx_waiters && (was_empty || eth_rx_ready(port, now_us))) {
+        pthread_cond_signal(&port->rx_cond);
+    }
+    return queued;
+}
+
+/**
+ * @brief Leave poll mode, freeing the frames still queued; called with the port lock held
+ *
+ * @param port Port state
+ */
+static void eth_rx_ring_release(eth_port_state_t *port) {
+    packet_t *pkts[PACKET_BURST_MAX];
+    packet_ring_t *ring = port->rx_ring;
+    uint32_t count;
+
+    if (ring == NULL) {
+        return;
+    }
+    __atomic_store_n(&port->rx_ring, NULL, __ATOMIC_RELEASE);
+
+    while ((count = packet_ring_dequeue_burst(ring, pkts, PACKET_BURST_MAX)) > 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            packet_buffer_free(pkts[i]);
+        }
+    }
+    packet_ring_destroy(ring);
+    pthread_cond_destroy(&port->rx_cond);
+    port->rx_waiters = 0;
+}
+
+/**
+ * @brief Handle a frame delivered by the simulation driver
+ *
+ * In poll mode a copy of the frame is queued for the poller, otherwise the
+ * frame is passed to the RX callback.
+ *
+ * @param port_id Port identifier
+ * @param packet Received frame, left to the caller
+ *
+ * @return STATUS_SUCCESS on success, error code otherwise
+ */
+static status_t eth_handle_received_packet(uint16_t port_id, const packet_t *packet) {
+    if (port_id >= ETH_MAX_PORTS || packet == NULL) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    eth_port_state_t *port = &g_eth_driver.ports[port_id];
+
+    /* The filters take no lock and drop before the poll-mode copy */
+    if (!eth_rx_filter_pass(port, packet)) {
+        return STATUS_SUCCESS;
+    }
+
+    pthread_mutex_lock(&port->lock);
+
+    if (!port->is_open) {
+        pthread_mutex_unlock(&port->lock);
+        return STATUS_NOT_FOUND;
+    }
+
+    eth_rx_count(port, packet);
+
+    if (port->rx_ring) {
+        packet_t *copy = packet_buffer_clone(packet);
+        if (copy == NULL) {
+            stats_shard_add(&eth_port_counters(port)->rx_dropped, 1);
+            pthread_mutex_unlock(&port->lock);
+            return STATUS_NO_MEMORY;
+        }
+        uint32_t queued = eth_rx_ring_push(port, &copy, 1);
+        pthread_mutex_unlock(&port->lock);
+        if (queued == 0) {
+            packet_buffer_free(copy);
+            return STATUS_RESOURCE_BUSY;
+        }
+        return STATUS_SUCCESS;
+    }
+
+    eth_rx_callback_t callback = port->rx_callback;
+    void *user_data = port->rx_user_data;
+    pthread_mutex_unlock(&port->lock);
+
+    if (callback) {
+        callback(port_id, packet, user_data);
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Switch a port between callback and poll-mode reception
+ *
+ * @param port_id Port identifier
+ * @param enable true for poll mode
+ * @param coalesce Wakeup coalescing, NULL to wake on every frame
+ *
+ * @return STATUS_SUCCESS on success, error code otherwise
+ */
+status_t eth_port_set_rx_poll_mode(uint16_t port_id, bool enable, const eth_rx_coalesce_t *coalesce) {
+    /* Check if driver is initialized */
+    if (!g_eth_driver.initialized) {
+        LOG_ERROR("Ethernet driver not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    /* Validate port ID */
+    if (port_id >= ETH_MAX_PORTS) {
+        LOG_ERROR("Invalid port ID: %u", port_id);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Lock the port state */
+    eth_port_state_t *port = &g_eth_driver.ports[port_id];
+    pthread_mutex_lock(&port->lock);
+
+    /* Check if port is open */
+    if (!port->is_open) {
+        LOG_ERROR("Port %u is not open", port_id);
+        pthread_mutex_unlock(&port->lock);
+        return STATUS_NOT_FOUND;
+    }
+
+    if (!enable) {
+        eth_rx_ring_release(port);
+        if (port->host == NULL && port->rx_callback == NULL) {
+            sim_driver_unregister_rx_handler(port_id);
+        }
+        pthread_mutex_unlock(&port->lock);
+        LOG_INFO("RX poll mode disabled for port %u", port_id);
+        return STATUS_SUCCESS;
+    }
+
+    if (coalesce) {
+        port->coalesce = *coalesce;
+    } else {
+        port->coalesce.max_packets = 1;
+        port->coalesce.max_usecs = 0;
+    }
+
+    /* Already polled: only the coalescing changes */
+    if (port->rx_ring) {
+        pthread_mutex_unlock(&port->lock);
+        return STATUS_SUCCESS;
+    }
+
+    packet_ring_t *ring = packet_ring_create(ETH_RX_RING_SIZE);
+    if (ring == NULL) {
+        LOG_ERROR("Failed to allocate RX ring for port %u", port_id);
+        pthread_mutex_unlock(&port->lock);
+        return STATUS_NO_MEMORY;
+    }
+
+    /* Waits are timed against the monotonic clock, like the coalescing */
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&port->rx_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    /* Simulated ports receive through the simulation driver */
+    if (port->host == NULL) {
+        status_t status = sim_driver_register_rx_handler(port_id, eth_handle_received_packet);
+        if (status != STATUS_SUCCESS) {
+            LOG_ERROR("Failed to register RX handler with simulation driver: %d", status);
+            pthread_cond_destroy(&port->rx_cond);
+            packet_ring_destroy(ring);
+            pthread_mutex_unlock(&port->lock);
+            return status;
+        }
+    }
+
+    port->rx_waiters = 0;
+    port->rx_pending_since_us = 0;
+    __atomic_store_n(&port->rx_ring, ring, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&port->lock);
+    LOG_INFO("RX poll mode enabled for port %u (%u packets, %u us)", port_id,
+             port->coalesce.max_packets, port->coalesce.max_usecs);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Take a burst of received frames from a poll-mode port
+ *
+ * @param port_id Port identifier
+ * @param[out] pkts Received packets
+ * @param n Size of pkts
+ *
+ * @return Number of packets taken
+ */
+uint32_t eth_port_rx_burst(uint16_t port_id, packet_t **pkts, uint32_t n) {
+    if (port_id >= ETH_MAX_PORTS || pkts == NULL) {
+        return 0;
+    }
+
+    packet_ring_t *ring = __atomic_load_n(&g_eth_driver.ports[port_id].rx_ring, __ATOMIC_ACQUIRE);
+    if (ring == NULL) {
+        return 0;
+    }
+    return packet_ring_dequeue_burst(ring, pkts, n);
+}
+
+/**
+ * @brief Sleep until a poll-mode port has frames by its coalescing rules
+ *
+ * @param port_id Port identifier
+ * @param timeout_us Longest wait
+ *
+ * @return true if frames are ready
+ */
+bool eth_port_rx_wait(uint16_t port_id, uint32_t timeout_us) {
+    if (port_id >= ETH_MAX_PORTS) {
+        return false;
+    }
+
+    eth_port_state_t *port = &g_eth_driver.ports[port_id];
+    pthread_mutex_lock(&port->lock);
+
+    if (port->rx_ring == NULL) {
+        pthread_mutex_unlock(&port->lock);
+        return false;
+    }
+
+    uint64_t now_us = eth_now_us();
+    uint64_t deadline_us = now_us + timeout_us;
+
+    while (!eth_rx_ready(port, now_us) && now_us < deadline_us) {
+        uint64_t wake_us = deadline_us;
+
+        /* Frames already queued are due max_usecs after the first of them */
+        if (port->coalesce.max_usecs != 0 && packet_ring_count(port->rx_ring) > 0) {
+            uint64_t due_us = port->rx_pending_since_us + port->coalesce.max_usecs;
+            if (due_us < wake_us) {
+                wake_us = due_us;
+            }
+        }
+
+        struct timespec ts = {
+            .tv_sec = (time_t)(wake_us / 1000000ULL),
+            .tv_nsec = (long)(wake_us % 1000000ULL) * 1000,
+        };
+        port->rx_waiters++;
+        pthread_cond_timedwait(&port->rx_cond, &port->lock, &ts);
+        port->rx_waiters--;
+        now_us = eth_now_us();
+    }
+
+    /* On timeout, whatever is queued is still worth a burst */
+    bool ready = packet_ring_count(port->rx_ring) > 0;
+    pthread_mutex_unlock(&port->lock);
+    return ready;
+}
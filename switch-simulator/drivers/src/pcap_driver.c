@@ -0,0 +1,998 @@
+/**
+ * @file pcap_driver.c
+ * @brief pcap/pcapng replay and egress capture
+ *
+ * Replay walks the mapped file with a cursor and copies each frame into a
+ * pooled buffer; the only system calls are the sleeps between frames that
+ * are due later. The monotonic clock is read once per burst and whenever
+ * the next frame is due after the last reading.
+ *
+ * The capture ring is single producer, single consumer: the port's TX
+ * drain writes whole records (pcap record header and frame) and publishes
+ * its head with a release store once per burst; the writer thread writes
+ * everything between its tail and that head with one writev() and then
+ * releases the space.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "pcap_driver.h"
+#include "common/logging.h"
+#include "common/config.h"
+#include "hal/hw_resources.h"
+#include "hal/hw_simulation.h"
+#include "hal/packet.h"
+
+#define PCAP_MAGIC_USEC             0xa1b2c3d4
+#define PCAP_MAGIC_NSEC             0xa1b23c4d
+#define PCAP_FILE_HEADER_LEN        24
+#define PCAP_RECORD_HEADER_LEN      16
+#define PCAP_LINKTYPE_ETHERNET      1
+
+#define PCAPNG_BLOCK_SHB            0x0A0D0D0A
+#define PCAPNG_BLOCK_IDB            0x00000001
+#define PCAPNG_BLOCK_SPB            0x00000003
+#define PCAPNG_BLOCK_EPB            0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC     0x1A2B3C4D
+#define PCAPNG_OPT_END              0
+#define PCAPNG_OPT_COMMENT          1
+#define PCAPNG_OPT_IF_NAME          2
+#define PCAPNG_OPT_IF_TSRESOL       9
+#define PCAPNG_MAX_INTERFACES       64
+
+#define PCAP_REPLAY_SPIN_NS         50000       /* Waits shorter than this spin */
+#define PCAP_REPLAY_MAX_SLEEP_NS    100000000   /* Longest sleep between checks for stop */
+#define PCAP_REPLAY_RETRY_US        50          /* Max rate: pause before retrying a full ring */
+#define PCAP_REPLAY_MAX_RETRIES     2000        /* Max rate: fruitless retries before dropping */
+
+#define PCAP_CAPTURE_WRITE_MIN      (64u << 10) /* Bytes worth a write before the flush interval */
+#define PCAP_CAPTURE_FLUSH_NS       10000000    /* Longest a record waits in the ring */
+#define PCAP_CAPTURE_IDLE_US        1000
+
+/* Capture file formats */
+typedef enum {
+    PCAP_FORMAT_PCAP = 0,
+    PCAP_FORMAT_PCAPNG
+} pcap_format_t;
+
+/* pcapng interface: timestamps are ts * mul / div nanoseconds */
+typedef struct {
+    uint16_t linktype;
+    uint64_t ts_mul;
+    uint64_t ts_div;
+    port_id_t port;                 /* From an if_name of "portN", PORT_ID_INVALID otherwise */
+} pcapng_if_t;
+
+/* Position in the file */
+typedef struct {
+    size_t offset;
+    bool swapped;                   /* Byte order of the file or the current section */
+    uint32_t if_count;
+    pcapng_if_t ifs[PCAPNG_MAX_INTERFACES];
+} pcap_cursor_t;
+
+struct pcap_replay {
+    int fd;
+    const uint8_t *map;
+    size_t size;
+    pcap_format_t format;
+    bool swapped;                   /* pcap: file byte order differs from ours */
+    bool nsec;                      /* pcap: nanosecond timestamps */
+    uint32_t linktype;              /* pcap: link type of every record */
+    pcap_replay_config_t config;
+    pthread_t thread;
+    bool started;
+    bool running;
+    pcap_replay_stats_t stats;
+};
+
+struct pcap_capture {
+    driver_t base;                  /* First, so the capture is a driver_t */
+    port_id_t port;
+    driver_handle_t next;           /* Driver the port had before */
+    int fd;
+    uint8_t *ring;
+    uint64_t size;
+    uint64_t mask;
+    uint64_t head;                  /* Written by the TX side */
+    uint64_t tail;                  /* Written by the writer thread */
+    uint32_t snaplen;
+    pthread_t writer;
+    bool running;
+    pcap_capture_stats_t stats;
+};
+
+static inline uint16_t pcap_rd16(const uint8_t *p, bool swapped) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return swapped ? __builtin_bswap16(v) : v;
+}
+
+static inline uint32_t pcap_rd32(const uint8_t *p, bool swapped) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return swapped ? __builtin_bswap32(v) : v;
+}
+
+static inline uint64_t pcap_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* ---------------------------------------------------------------------------
+ * Replay
+ * ------------------------------------------------------------------------- */
+
+/**
+ * @brief Set an interface's timestamp units from its if_tsresol option
+ *
+ * The default is microseconds. A resolution of 10^-v or 2^-v seconds.
+ */
+static void pcapng_set_tsresol(pcapng_if_t *ifc, uint8_t resol) {
+    uint8_t v = resol & 0x7f;
+
+    ifc->ts_mul = 1;
+    ifc->ts_div = 1;
+    if (resol & 0x80) {
+        ifc->ts_mul = 1000000000ULL;
+        ifc->ts_div = v < 64 ? 1ULL << v : 1;
+    } else if (v <= 9) {
+        while (v++ < 9) {
+            ifc->ts_mul *= 10;
+        }
+    } else {
+        for (uint8_t i = 9; i < v && i < 28; i++) {
+            ifc->ts_div *= 10;
+        }
+    }
+}
+
+/**
+ * @brief Add the interface described by an IDB body
+ */
+static void pcapng_add_interface(pcap_cursor_t *cur, const uint8_t *body, uint32_t body_len) {
+    if (cur->if_count >= PCAPNG_MAX_INTERFACES || body_len < 8) {
+        if (cur->if_count < PCAPNG_MAX_INTERFACES) {
+            cur->if_count++;
+        }
+        return;
+    }
+
+    pcapng_if_t *ifc = &cur->ifs[cur->if_count++];
+    ifc->linktype = pcap_rd16(body, cur->swapped);
+    ifc->port = PORT_ID_INVALID;
+    pcapng_set_tsresol(ifc, 6);
+
+    /* Options: code, length, value padded to four bytes */
+    uint32_t off = 8;
+    while (off + 4 <= body_len) {
+        uint16_t code = pcap_rd16(body + off, cur->swapped);
+        uint16_t len = pcap_rd16(body + off + 2, cur->swapped);
+        if (code == PCAPNG_OPT_END || off + 4 + len > body_len) {
+            break;
+        }
+        if (code == PCAPNG_OPT_IF_TSRESOL && len >= 1) {
+            pcapng_set_tsresol(ifc, body[off + 4]);
+        } else if (code == PCAPNG_OPT_IF_NAME && len > 4 && len < 16 &&
+                   memcmp(body + off + 4, "port", 4) == 0) {
+            char name[16];
+            char *end;
+            memcpy(name, body + off + 8, len - 4u);
+            name[len - 4] = '\0';
+            unsigned long port = strtoul(name, &end, 10);
+            if (end != name && *end == '\0' && port < PORT_ID_INVALID) {
+                ifc->port = (port_id_t)port;
+            }
+        }
+        off += 4 + ((len + 3u) & ~3u);
+    }
+}
+
+/**
+ * @brief Next frame of a classic pcap file
+ */
+static bool pcap_next_pcap(pcap_replay_t *replay, pcap_cursor_t *cur, const uint8_t **data,
+                           uint32_t *len, uint64_t *ts_ns, bool *has_ts, port_id_t *port) {
+    while (cur->offset + PCAP_RECORD_HEADER_LEN <= replay->size) {
+        const uint8_t *rec = replay->map + cur->offset;
+        uint32_t sec = pcap_rd32(rec, replay->swapped);
+        uint32_t frac = pcap_rd32(rec + 4, replay->swapped);
+        uint32_t caplen = pcap_rd32(rec + 8, replay->swapped);
+
+        if (caplen > replay->size - cur->offset - PCAP_RECORD_HEADER_LEN) {
+            /* Truncated last record */
+            __atomic_fetch_add(&replay->stats.skipped, 1, __ATOMIC_RELAXED);
+            cur->offset = replay->size;
+            return false;
+        }
+        cur->offset += PCAP_RECORD_HEADER_LEN + caplen;
+
+        if (replay->linktype != PCAP_LINKTYPE_ETHERNET || caplen < 14) {
+            __atomic_fetch_add(&replay->stats.skipped, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        *data = rec + PCAP_RECORD_HEADER_LEN;
+        *len = caplen;
+        *ts_ns = (uint64_t)sec * 1000000000ULL + (replay->nsec ? frac : (uint64_t)frac * 1000);
+        *has_ts = true;
+        *port = replay->config.port;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Next Ethernet frame of a pcapng file
+ */
+static bool pcap_next_pcapng(pcap_replay_t *replay, pcap_cursor_t *cur, const uint8_t **data,
+                             uint32_t *len, uint64_t *ts_ns, bool *has_ts, port_id_t *port) {
+    while (cur->offset + 12 <= replay->size) {
+        const uint8_t *blk = replay->map + cur->offset;
+        uint32_t type = pcap_rd32(blk, cur->swapped);
+
+        /* A section header sets the byte order of everything up to the next one */
+        if (type == PCAPNG_BLOCK_SHB || type == __builtin_bswap32(PCAPNG_BLOCK_SHB)) {
+            uint32_t magic;
+            memcpy(&magic, blk + 8, sizeof(magic));
+            if (magic == PCAPNG_BYTE_ORDER_MAGIC) {
+                cur->swapped = false;
+            } else if (magic == __builtin_bswap32(PCAPNG_BYTE_ORDER_MAGIC)) {
+                cur->swapped = true;
+            } else {
+                break;
+            }
+            cur->if_count = 0;
+            type = PCAPNG_BLOCK_SHB;
+        }
+
+        uint32_t total = pcap_rd32(blk + 4, cur->swapped);
+        if (total < 12 || (total & 3) || total > replay->size - cur->offset) {
+            break;
+        }
+        cur->offset += total;
+
+        const uint8_t *body = blk + 8;
+        uint32_t body_len = total - 12;
+        uint32_t if_id = 0;
+        uint32_t caplen;
+        const uint8_t *frame;
+        uint64_t ts = 0;
+        bool stamped = false;
+
+        if (type == PCAPNG_BLOCK_IDB) {
+            pcapng_add_interface(cur, body, body_len);
+            continue;
+        } else if (type == PCAPNG_BLOCK_EPB && body_len >= 20) {
+            if_id = pcap_rd32(body, cur->swapped);
+            caplen = pcap_rd32(body + 12, cur->swapped);
+            frame = body + 20;
+            if (caplen > body_len - 20) {
+                __atomic_fetch_add(&replay->stats.skipped, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+            ts = ((uint64_t)pcap_rd32(body + 4, cur->swapped) << 32) | pcap_rd32(body + 8, cur->swapped);
+            stamped = true;
+        } else if (type == PCAPNG_BLOCK_SPB && body_len >= 4) {
+            caplen = pcap_rd32(body, cur->swapped);
+            if (caplen > body_len - 4) {
+                caplen = body_len - 4;
+            }
+            frame = body + 4;
+        } else {
+            /* Statistics, name resolution and the like */
+            continue;
+        }
+
+        if (if_id >= cur->if_count || if_id >= PCAPNG_MAX_INTERFACES ||
+            cur->ifs[if_id].linktype != PCAP_LINKTYPE_ETHERNET || caplen < 14) {
+            __atomic_fetch_add(&replay->stats.skipped, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (stamped) {
+            const pcapng_if_t *ifc = &cur->ifs[if_id];
+            *ts_ns = (uint64_t)((unsigned __int128)ts * ifc->ts_mul / ifc->ts_div);
+        }
+        *has_ts = stamped;
+        *data = frame;
+        *len = caplen;
+        *port = replay->config.port;
+        if (replay->config.by_interface) {
+            /* SPBs carry no interface and belong to the first one */
+            *port = cur->ifs[if_id].port;
+            if (*port == PORT_ID_INVALID) {
+                __atomic_fetch_add(&replay->stats.skipped, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Wait until a monotonic time, sleeping for most of it
+ *
+ * @return false if the replay was stopped meanwhile
+ */
+static bool pcap_wait_until(pcap_replay_t *replay, uint64_t due_ns) {
+    for (;;) {
+        if (!__atomic_load_n(&replay->running, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        uint64_t now = pcap_now_ns();
+        if (now >= due_ns) {
+            return true;
+        }
+        if (due_ns - now <= PCAP_REPLAY_SPIN_NS) {
+            sched_yield();
+            continue;
+        }
+
+        uint64_t wake = due_ns - PCAP_REPLAY_SPIN_NS;
+        if (wake - now > PCAP_REPLAY_MAX_SLEEP_NS) {
+            wake = now + PCAP_REPLAY_MAX_SLEEP_NS;
+        }
+        struct timespec ts = {
+            .tv_sec = (time_t)(wake / 1000000000ULL),
+            .tv_nsec = (long)(wake % 1000000000ULL),
+        };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+}
+
+/**
+ * @brief Queue a burst on a port's RX ring; what does not fit is freed
+ */
+static void pcap_replay_flush(pcap_replay_t *replay, port_id_t port, packet_buffer_t **pkts, uint32_t n) {
+    uint32_t queued = 0;
+    uint32_t retries = 0;
+    uint64_t bytes = 0;
+
+    if (n == 0) {
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        bytes += pkts[i]->length;
+    }
+
+    for (;;) {
+        uint32_t done = hw_sim_rx_enqueue_burst(port, pkts + queued, n - queued);
+        queued += done;
+        if (queued == n || replay->config.timing != PCAP_REPLAY_MAX_RATE ||
+            !__atomic_load_n(&replay->running, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+
+        /* Max rate: wait for the workers, unless the port takes nothing at all */
+        retries = done ? 0 : retries + 1;
+        if (retries > PCAP_REPLAY_MAX_RETRIES) {
+            break;
+        }
+        usleep(PCAP_REPLAY_RETRY_US);
+    }
+
+    for (uint32_t i = queued; i < n; i++) {
+        bytes -= pkts[i]->length;
+        packet_buffer_free(pkts[i]);
+    }
+    __atomic_fetch_add(&replay->stats.packets, queued, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&replay->stats.bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&replay->stats.dropped, n - queued, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Replay thread
+ */
+static void *pcap_replay_thread(void *arg) {
+    pcap_replay_t *replay = (pcap_replay_t *)arg;
+    const pcap_replay_config_t *config = &replay->config;
+    packet_buffer_t *pkts[PACKET_BURST_MAX];
+    uint32_t burst = config->burst ? config->burst : PCAP_REPLAY_DEFAULT_BURST;
+    bool timed = config->timing != PCAP_REPLAY_MAX_RATE;
+    double speed = config->timing == PCAP_REPLAY_SCALED ? config->speed : 1.0;
+
+    if (burst > PACKET_BURST_MAX) {
+        burst = PACKET_BURST_MAX;
+    }
+
+    for (;;) {
+        pcap_cursor_t cur;
+        const uint8_t *data;
+        uint32_t len;
+        port_id_t port = config->port;
+        port_id_t burst_port = config->port;
+        uint64_t ts = 0;
+        uint64_t first_ts = 0;
+        bool has_first = false;
+        bool has_ts = false;
+        uint64_t start = pcap_now_ns();
+        uint64_t now = start;
+        uint32_t n = 0;
+
+        memset(&cur, 0, sizeof(cur));
+        cur.offset = replay->format == PCAP_FORMAT_PCAP ? PCAP_FILE_HEADER_LEN : 0;
+
+        while (__atomic_load_n(&replay->running, __ATOMIC_ACQUIRE)) {
+            /* A frame without a timestamp goes with the one before it */
+            bool more = replay->format == PCAP_FORMAT_PCAP ?
+                        pcap_next_pcap(replay, &cur, &data, &len, &ts, &has_ts, &port) :
+                        pcap_next_pcapng(replay, &cur, &data, &len, &ts, &has_ts, &port);
+            if (!more) {
+                break;
+            }
+            if (!has_first && has_ts) {
+                first_ts = ts;
+                has_first = true;
+            }
+
+            if (timed && has_first) {
+                uint64_t offset = ts > first_ts ? ts - first_ts : 0;
+                uint64_t due = start + (speed == 1.0 ? offset : (uint64_t)((double)offset / speed));
+                if (due > now) {
+                    now = pcap_now_ns();
+                }
+                if (due > now) {
+                    pcap_replay_flush(replay, burst_port, pkts, n);
+                    n = 0;
+                    if (!pcap_wait_until(replay, due)) {
+                        break;
+                    }
+                    now = pcap_now_ns();
+                }
+            }
+
+            /* A burst goes to one port, so a frame for another ends it */
+            if (n > 0 && port != burst_port) {
+                pcap_replay_flush(replay, burst_port, pkts, n);
+                n = 0;
+            }
+            burst_port = port;
+
+            packet_buffer_t *packet = len <= CONFIG_PACKET_SEGMENT_SIZE ?
+                                      packet_segment_alloc() : packet_buffer_alloc(len);
+            if (!packet) {
+                __atomic_fetch_add(&replay->stats.dropped, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+            memcpy(packet->data, data, len);
+            packet->length = len;
+
+            pkts[n++] = packet;
+            if (n == burst) {
+                pcap_replay_flush(replay, burst_port, pkts, n);
+                n = 0;
+                now = pcap_now_ns();
+            }
+        }
+        pcap_replay_flush(replay, burst_port, pkts, n);
+
+        if (!__atomic_load_n(&replay->running, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        __atomic_fetch_add(&replay->stats.loops, 1, __ATOMIC_RELAXED);
+        if (!config->loop) {
+            __atomic_store_n(&replay->stats.done, true, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Map a capture file for replay
+ *
+ * @param path Capture file
+ * @param[out] replay New replay
+ * @return STATUS_SUCCESS on success, error code otherwise
+ */
+status_t pcap_replay_open(const char *path, pcap_replay_t **replay) {
+    if (!path || !replay) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOG_ERROR(LOG_CATEGORY_DRIVER, "Cannot open capture %s: %s", path, strerror(errno));
+        return STATUS_NOT_FOUND;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < PCAP_FILE_HEADER_LEN) {
+        LOG_ERROR(LOG_CATEGORY_DRIVER, "Capture %s is too short", path);
+        close(fd);
+        return STATUS_INVALID_PACKET;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        LOG_ERROR(LOG_CATEGORY_DRIVER, "Cannot map capture %s: %s", path, strerror(errno));
+        close(fd);
+        return STATUS_NO_MEMORY;
+    }
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    pcap_replay_t *r = calloc(1, sizeof(*r));
+    if (!r) {
+        munmap(map, (size_t)st.st_size);
+        close(fd);
+        return STATUS_NO_MEMORY;
+    }
+    r->fd = fd;
+    r->map = map;
+    r->size = (size_t)st.st_size;
+
+    uint32_t magic;
+    memcpy(&magic, r->map, sizeof(magic));
+    if (magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC ||
+        magic == __builtin_bswap32(PCAP_MAGIC_USEC) || magic == __builtin_bswap32(PCAP_MAGIC_NSEC)) {
+        r->format = PCAP_FORMAT_PCAP;
+        r->swapped = magic == __builtin_bswap32(PCAP_MAGIC_USEC) ||
+                     magic == __builtin_bswap32(PCAP_MAGIC_NSEC);
+        r->nsec = magic == PCAP_MAGIC_NSEC || magic == __builtin_bswap32(PCAP_MAGIC_NSEC);
+        r->linktype = pcap_rd32(r->map + 20, r->swapped) & 0xffff;
+    } else if (magic == PCAPNG_BLOCK_SHB) {
+        r->format = PCAP_FORMAT_PCAPNG;
+    } else {
+        LOG_ERROR(LOG_CATEGORY_DRIVER, "%s is not a pcap or pcapng capture", path);
+        pcap_replay_close(r);
+        return STATUS_INVALID_PACKET;
+    }
+
+    LOG_INFO(LOG_CATEGORY_DRIVER, "Mapped %s capture %s, %zu bytes",
+             r->format == PCAP_FORMAT_PCAP ? "pcap" : "pcapng", path, r->size);
+    *replay = r;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Start replaying on a thread of its own
+ *
+ * @param replay Replay, not running
+ * @param config Parameters
+ * @return STATUS_SUCCESS on success, error code otherwise
+ */
+status_t pcap_replay_start(pcap_replay_t *replay, const pcap_replay_config_t *config) {
+    if (!replay || !config) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (config->timing == PCAP_REPLAY_SCALED && !(config->speed > 0.0)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (replay->started) {
+        return STATUS_RESOURCE_BUSY;
+    }
+
+    replay->config = *config;
+    memset(&replay->stats, 0, sizeof(replay->stats));
+    __atomic_store_n(&replay->running, true, __ATOMIC_RELEASE);
+    if (pthread_create(&replay->thread, NULL, pcap_replay_thread, replay) != 0) {
+        replay->running = false;
+        return STATUS_FAILURE;
+    }
+    replay->started = true;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Stop replaying and wait for the thread
+ *
+ * @param replay Replay
+ */
+void pcap_replay_stop(pcap_replay_t *replay) {
+    if (!replay || !replay->started) {
+        return;
+    }
+    __atomic_store_n(&replay->running, false, __ATOMIC_RELEASE);
+    pthread_join(replay->thread, NULL);
+    replay->started = false;
+}
+
+/**
+ * @brief Stop replaying and unmap the file
+ *
+ * @param replay Replay, may be NULL
+ */
+void pcap_replay_close(pcap_replay_t *replay) {
+    if (!replay) {
+        return;
+    }
+    pcap_replay_stop(replay);
+    munmap((void *)replay->map, replay->size);
+    close(replay->fd);
+    free(replay);
+}
+
+/**
+ * @brief Get the comments of the first section header of a pcapng file
+ *
+ * @param replay Replay
+ * @param buf Output buffer, NUL-terminated
+ * @param size Size of buf
+ * @param[out] length Length of the comments, which are truncated if not less than size
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NOT_FOUND
+ *         if there are none
+ */
+status_t pcap_replay_get_comment(const pcap_replay_t *replay, char *buf, size_t size, size_t *length) {
+    if (!replay || !buf || size == 0 || !length) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    buf[0] = '\0';
+    *length = 0;
+    if (replay->format != PCAP_FORMAT_PCAPNG || replay->size < 28) {
+        return STATUS_NOT_FOUND;
+    }
+
+    uint32_t magic;
+    memcpy(&magic, replay->map + 8, sizeof(magic));
+    bool swapped = magic != PCAPNG_BYTE_ORDER_MAGIC;
+    uint32_t total = pcap_rd32(replay->map + 4, swapped);
+    if (total < 28 || total > replay->size) {
+        return STATUS_NOT_FOUND;
+    }
+
+    /* Options follow the magic, the version and the section length */
+    const uint8_t *opts = replay->map + 24;
+    uint32_t opts_len = total - 28;
+    uint32_t off = 0;
+    bool found = false;
+    while (off + 4 <= opts_len) {
+        uint16_t code = pcap_rd16(opts + off, swapped);
+        uint16_t len = pcap_rd16(opts + off + 2, swapped);
+        if (code == PCAPNG_OPT_END || off + 4 + len > opts_len) {
+            break;
+        }
+        if (code == PCAPNG_OPT_COMMENT) {
+            /* Long text is split over several comments */
+            if (*length < size - 1) {
+                size_t take = size - 1 - *length < len ? size - 1 - *length : len;
+                memcpy(buf + *length, opts + off + 4, take);
+                buf[*length + take] = '\0';
+            }
+            *length += len;
+            found = true;
+        }
+        off += 4 + ((len + 3u) & ~3u);
+    }
+    return found ? STATUS_SUCCESS : STATUS_NOT_FOUND;
+}
+
+/**
+ * @brief Get the counters of a replay
+ *
+ * @param replay Replay
+ * @param[out] stats Counters
+ */
+void pcap_replay_get_stats(const pcap_replay_t *replay, pcap_replay_stats_t *stats) {
+    if (!replay || !stats) {
+        return;
+    }
+    stats->packets = __atomic_load_n(&replay->stats.packets, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&replay->stats.bytes, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&replay->stats.dropped, __ATOMIC_RELAXED);
+    stats->skipped = __atomic_load_n(&replay->stats.skipped, __ATOMIC_RELAXED);
+    stats->loops = __atomic_load_n(&replay->stats.loops, __ATOMIC_RELAXED);
+    stats->done = __atomic_load_n(&replay->stats.done, __ATOMIC_ACQUIRE);
+}
+
+/* ---------------------------------------------------------------------------
+ * Capture
+ * ------------------------------------------------------------------------- */
+
+/**
+ * @brief Copy bytes into the ring at a position, wrapping at the end
+ */
+static void pcap_ring_put(pcap_capture_t *cap, uint64_t pos, const void *src, uint32_t len) {
+    uint64_t off = pos & cap->mask;
+    uint64_t first = cap->size - off < len ? cap->size - off : len;
+
+    memcpy(cap->ring + off, src, first);
+    memcpy(cap->ring, (const uint8_t *)src + first, len - first);
+}
+
+/**
+ * @brief Copy the first len bytes of a (possibly chained) frame into the ring
+ */
+static void pcap_ring_put_packet(pcap_capture_t *cap, uint64_t pos, const packet_t *pkt, uint32_t len) {
+    uint64_t off = pos & cap->mask;
+    uint32_t first = cap->size - off < len ? (uint32_t)(cap->size - off) : len;
+
+    if (!pkt->next) {
+        pcap_ring_put(cap, pos, pkt->data, len);
+        return;
+    }
+    packet_copy_data(pkt, 0, cap->ring + off, first);
+    packet_copy_data(pkt, first, cap->ring, len - first);
+}
+
+/**
+ * @brief Record a burst in the ring
+ *
+ * Frames that do not fit are counted and left out of the file; they are
+ * still sent.
+ */
+static void pcap_capture_record(pcap_capture_t *cap, packet_t *const *pkts, uint16_t n) {
+    uint64_t head = cap->head;
+    uint64_t tail = __atomic_load_n(&cap->tail, __ATOMIC_ACQUIRE);
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    for (uint16_t i = 0; i < n; i++) {
+        uint32_t len = packet_chain_length(pkts[i]);
+        uint32_t incl = len < cap->snaplen ? len : cap->snaplen;
+        uint32_t rec = PCAP_RECORD_HEADER_LEN + incl;
+
+        if (cap->size - (head - tail) < rec) {
+            tail = __atomic_load_n(&cap->tail, __ATOMIC_ACQUIRE);
+            if (cap->size - (head - tail) < rec) {
+                __atomic_fetch_add(&cap->stats.dropped, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+        }
+
+        uint32_t hdr[4] = { (uint32_t)now.tv_sec, (uint32_t)now.tv_nsec, incl, len };
+        pcap_ring_put(cap, head, hdr, sizeof(hdr));
+        pcap_ring_put_packet(cap, head + sizeof(hdr), pkts[i], incl);
+        head += rec;
+        packets++;
+        bytes += len;
+    }
+
+    __atomic_store_n(&cap->head, head, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&cap->stats.packets, packets, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cap->stats.bytes, bytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Write a span of the ring to the file
+ *
+ * @return false on a write error
+ */
+static bool pcap_capture_write(pcap_capture_t *cap, uint64_t tail, uint64_t head) {
+    while (tail < head) {
+        uint64_t off = tail & cap->mask;
+        uint64_t len = head - tail;
+        struct iovec iov[2];
+        int iovcnt = 1;
+
+        iov[0].iov_base = cap->ring + off;
+        iov[0].iov_len = len;
+        if (off + len > cap->size) {
+            iov[0].iov_len = cap->size - off;
+            iov[1].iov_base = cap->ring;
+            iov[1].iov_len = len - iov[0].iov_len;
+            iovcnt = 2;
+        }
+
+        ssize_t done = writev(cap->fd, iov, iovcnt);
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            return false;
+        }
+        tail += (uint64_t)done;
+        __atomic_store_n(&cap->tail, tail, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&cap->stats.file_bytes, (uint64_t)done, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&cap->stats.writes, 1, __ATOMIC_RELAXED);
+    }
+    return true;
+}
+
+/**
+ * @brief Writer thread: moves the ring to the file in large writes
+ */
+static void *pcap_capture_writer(void *arg) {
+    pcap_capture_t *cap = (pcap_capture_t *)arg;
+    uint64_t last_write = pcap_now_ns();
+
+    for (;;) {
+        bool stop = !__atomic_load_n(&cap->running, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&cap->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = cap->tail;
+        uint64_t now = pcap_now_ns();
+
+        /* Small amounts wait for more, up to the flush interval */
+        if (head - tail == 0 ||
+            (!stop && head - tail < PCAP_CAPTURE_WRITE_MIN && now - last_write < PCAP_CAPTURE_FLUSH_NS)) {
+            if (stop) {
+                break;
+            }
+            usleep(PCAP_CAPTURE_IDLE_US);
+            continue;
+        }
+
+        if (!pcap_capture_write(cap, tail, head)) {
+            LOG_ERROR(LOG_CATEGORY_DRIVER, "Capture of port %u: write failed: %s",
+                      cap->port, strerror(errno));
+            /* Keep the TX side going; what is recorded from now on is discarded */
+            __atomic_store_n(&cap->tail, head, __ATOMIC_RELEASE);
+        }
+        last_write = now;
+    }
+
+    return NULL;
+}
+
+static uint16_t pcap_capture_transmit_burst(driver_t *drv, packet_t **pkts, uint16_t n) {
+    pcap_capture_t *cap = (pcap_capture_t *)drv;
+
+    pcap_capture_record(cap, pkts, n);
+    if (cap->next) {
+        return driver_transmit_burst(cap->next, pkts, n);
+    }
+    return (uint16_t)hw_sim_transmit_burst(cap->port, pkts, n);
+}
+
+static status_t pcap_capture_transmit(driver_t *drv, packet_t *pkt) {
+    return pcap_capture_transmit_burst(drv, &pkt, 1) == 1 ? STATUS_SUCCESS : STATUS_FAILURE;
+}
+
+static status_t pcap_capture_noop(driver_t *drv) {
+    (void)drv;
+    return STATUS_SUCCESS;
+}
+
+static const driver_ops_t g_pcap_capture_ops = {
+    .init = pcap_capture_noop,
+    .transmit = pcap_capture_transmit,
+    .shutdown = pcap_capture_noop,
+    .transmit_burst = pcap_capture_transmit_burst,
+};
+
+/**
+ * @brief Start capturing a port's egress to a file
+ *
+ * @param path Capture file
+ * @param config Parameters
+ * @param[out] capture New capture
+ * @return STATUS_SUCCESS on success, error code otherwise
+ */
+status_t pcap_capture_open(const char *path, const pcap_capture_config_t *config,
+                           pcap_capture_t **capture) {
+    if (!path || !config || !capture) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    uint32_t ring_size = config->ring_size ? config->ring_size : PCAP_CAPTURE_DEFAULT_RING;
+    uint32_t snaplen = config->snaplen ? config->snaplen : PCAP_CAPTURE_DEFAULT_SNAPLEN;
+    if ((ring_size & (ring_size - 1)) || ring_size < 2 * (PCAP_RECORD_HEADER_LEN + snaplen)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    port_config_t port_config;
+    status_t status = hw_sim_get_port_config(config->port, &port_config);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    pcap_capture_t *cap = calloc(1, sizeof(*cap));
+    if (!cap) {
+        return STATUS_NO_MEMORY;
+    }
+    cap->ring = malloc(ring_size);
+    if (!cap->ring) {
+        free(cap);
+        return STATUS_NO_MEMORY;
+    }
+    cap->base.ops = &g_pcap_capture_ops;
+    cap->base.drv_type = DRIVER_TYPE_VIRTUAL;
+    /* Stands in front of the port and advertises what it can take */
+    cap->base.flags = DRIVER_FLAG_TX_CAPABLE |
+                      (hw_sim_get_port_offloads(config->port) & DRIVER_FLAGS_OFFLOAD);
+    snprintf(cap->base.name, sizeof(cap->base.name), "pcap%u", config->port);
+    cap->port = config->port;
+    cap->next = port_config.driver;
+    cap->size = ring_size;
+    cap->mask = ring_size - 1;
+    cap->snaplen = snaplen;
+
+    cap->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (cap->fd < 0) {
+        LOG_ERROR(LOG_CATEGORY_DRIVER, "Cannot create capture %s: %s", path, strerror(errno));
+        free(cap->ring);
+        free(cap);
+        return STATUS_FAILURE;
+    }
+
+    /* Nanosecond pcap, Ethernet */
+    uint32_t header[6] = { PCAP_MAGIC_NSEC, 2 | (4u << 16), 0, 0, snaplen, PCAP_LINKTYPE_ETHERNET };
+    if (write(cap->fd, header, sizeof(header)) != (ssize_t)sizeof(header)) {
+        LOG_ERROR(LOG_CATEGORY_DRIVER, "Cannot write capture %s: %s", path, strerror(errno));
+        close(cap->fd);
+        free(cap->ring);
+        free(cap);
+        return STATUS_FAILURE;
+    }
+
+    __atomic_store_n(&cap->running, true, __ATOMIC_RELEASE);
+    if (pthread_create(&cap->writer, NULL, pcap_capture_writer, cap) != 0) {
+        close(cap->fd);
+        free(cap->ring);
+        free(cap);
+        return STATUS_FAILURE;
+    }
+
+    port_config.driver = &cap->base;
+    status = hw_sim_set_port_config(cap->port, &port_config);
+    if (status != STATUS_SUCCESS) {
+        __atomic_store_n(&cap->running, false, __ATOMIC_RELEASE);
+        pthread_join(cap->writer, NULL);
+        close(cap->fd);
+        free(cap->ring);
+        free(cap);
+        return status;
+    }
+
+    LOG_INFO(LOG_CATEGORY_DRIVER, "Capturing egress of port %u to %s", cap->port, path);
+    *capture = cap;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Give the port its previous driver back, flush and close the file
+ *
+ * @param capture Capture, may be NULL
+ */
+void pcap_capture_close(pcap_capture_t *capture) {
+    if (!capture) {
+        return;
+    }
+
+    port_config_t port_config;
+    if (hw_sim_get_port_config(capture->port, &port_config) == STATUS_SUCCESS &&
+        port_config.driver == &capture->base) {
+        port_config.driver = capture->next;
+        hw_sim_set_port_config(capture->port, &port_config);
+    }
+
+    /* The writer empties the ring before it exits */
+    __atomic_store_n(&capture->running, false, __ATOMIC_RELEASE);
+    pthread_join(capture->writer, NULL);
+
+    LOG_INFO(LOG_CATEGORY_DRIVER, "Capture of port %u closed: %llu packets, %llu dropped",
+             capture->port, (unsigned long long)capture->stats.packets,
+             (unsigned long long)capture->stats.dropped);
+    close(capture->fd);
+    free(capture->ring);
+    free(capture);
+}
+
+/**
+ * @brief Get the driver a capture installed on its port
+ */
+driver_handle_t pcap_capture_get_driver(pcap_capture_t *capture) {
+    return capture ? &capture->base : NULL;
+}
+
+/**
+ * @brief Get the counters of a capture
+ *
+ * @param capture Capture
+ * @param[out] stats Counters
+ */
+void pcap_capture_get_stats(const pcap_capture_t *capture, pcap_capture_stats_t *stats) {
+    if (!capture || !stats) {
+        return;
+    }
+    stats->packets = __atomic_load_n(&capture->stats.packets, __ATOMIC_RELAXED);
+    stats->bytes = __atomic_load_n(&capture->stats.bytes, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&capture->stats.dropped, __ATOMIC_RELAXED);
+    stats->file_bytes = __atomic_load_n(&capture->stats.file_bytes, __ATOMIC_RELAXED);
+    stats->writes = __atomic_load_n(&capture->stats.writes, __ATOMIC_RELAXED);
+}
@@ -6,16 +6,23 @@
  * including packet generation, traffic simulation, and network events.
  */
 
+#define _GNU_SOURCE
+
 #include "../include/sim_driver.h"
 #include "../../include/common/logging.h"
 #include "../../include/common/error_codes.h"
 #include "../../include/hal/packet.h"
 #include "../../include/hal/hw_resources.h"
+#include "../../include/hal/link_event.h"
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <time.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 /* Constants for simulation */
 #define SIM_MAX_PORTS 64
@@ -24,13 +31,39 @@
 #define SIM_MAX_PACKET_SIZE 1518
 #define SIM_MIN_PACKET_SIZE 64
 #define SIM_MAC_ADDR_LEN 6
+#define SIM_GEN_TEMPLATES 16        /* Prebuilt frames per port, sent in turn */
+#define SIM_GEN_BURST 32            /* Most frames a port sends before the next port's turn */
+#define SIM_GEN_MAX_LAG_US 10000    /* A port further behind than this skips ahead */
+#define SIM_GEN_SPIN_US 100         /* Waits shorter than this spin instead of sleeping */
+
+/* Pacing and templates of a port, owned by its generator thread */
+typedef struct {
+    uint64_t next_tsc;              /* Send time of the next frame */
+    uint64_t interval_tsc;          /* Whole clock ticks between frames */
+    uint64_t interval_rem;          /* Remainder of the interval, in 1/rate ticks */
+    uint64_t rem_acc;               /* Accumulated remainder */
+    uint32_t rate_pps;              /* 0 when the port sends nothing */
+    uint32_t next_template;
+    uint8_t *templates;             /* SIM_GEN_TEMPLATES frames of SIM_MAX_PACKET_SIZE */
+    uint16_t sizes[SIM_GEN_TEMPLATES];
+} sim_gen_port_t;
+
+/* Traffic generator thread */
+typedef struct {
+    pthread_t thread;
+    sim_context_t *ctx;
+    uint32_t index;
+    uint64_t rng;                   /* xorshift64 state */
+    uint32_t plan_generation;       /* Offered load the ports were planned for */
+    bool started;
+} sim_generator_t;
 
 /* Private function declarations */
 static void *sim_worker_thread(void *arg);
-static void simulate_traffic(sim_context_t *ctx);
-static void generate_random_packet(uint8_t *packet, size_t *packet_size, uint32_t src_port, uint32_t dst_port);
+static void *sim_generator_thread(void *arg);
+static sim_status_t sim_start_generators(sim_context_t *ctx);
+static void sim_stop_generators(sim_context_t *ctx);
 static void simulate_link_events(sim_context_t *ctx);
-static uint32_t get_random_port_id(sim_context_t *ctx);
 
 /* Global variables */
 static pthread_t sim_thread;
@@ -39,6 +72,9 @@ static packet_handler_t packet_callback = NULL;
 static void *packet_callback_context = NULL;
 static link_event_handler_t link_callback = NULL;
 static void *link_callback_context = NULL;
+static sim_generator_t sim_generators[SIM_MAX_GENERATORS];
+static sim_gen_port_t sim_gen_ports[SIM_MAX_PORTS];
+static uint64_t sim_tsc_hz = 0;
 
 /**
  * Initialize the simulation driver
@@ -75,6 +111,13 @@ sim_status_t sim_driver_init(sim_config_t *config) {
     ctx->traffic_rate = config->traffic_rate > 0 ? 
                        config->traffic_rate : SIM_DEFAULT_TRAFFIC_RATE;
     ctx->link_flap_probability = config->link_flap_probability;
+    ctx->num_generators = config->num_generators > 0 ? config->num_generators : 1;
+    if (ctx->num_generators > SIM_MAX_GENERATORS) {
+        ctx->num_generators = SIM_MAX_GENERATORS;
+    }
+    ctx->pin_generators = config->pin_generators;
+    ctx->plan_generation = 0;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
 
     /* Initialize port statuses */
     ctx->port_status = (sim_port_status_t *)malloc(config->num_ports * sizeof(sim_port_status_t));
@@ -84,6 +127,18 @@ sim_status_t sim_driver_init(sim_config_t *config) {
         return SIM_ERROR_MEMORY;
     }
 
+    /* Every port starts with the default offered load */
+    ctx->profiles = (sim_traffic_profile_t *)calloc(config->num_ports, sizeof(sim_traffic_profile_t));
+    if (ctx->profiles == NULL) {
+        LOG_ERROR("Failed to allocate memory for traffic profiles");
+        free(ctx->port_status);
+        free(ctx);
+        return SIM_ERROR_MEMORY;
+    }
+    for (uint32_t i = 0; i < config->num_ports; i++) {
+        ctx->profiles[i].dst_port = SIM_DST_RANDOM;
+    }
+
     /* Set initial port states */
     for (uint32_t i = 0; i < config->num_ports; i++) {
         ctx->port_status[i].link_up = true;
@@ -98,12 +153,13 @@ sim_status_t sim_driver_init(sim_config_t *config) {
     hw_sim_status_t status = hw_sim_register_driver(ctx);
     if (status != HW_SIM_SUCCESS) {
         LOG_ERROR("Failed to register simulation driver with hardware layer: %d", status);
+        free(ctx->profiles);
         free(ctx->port_status);
         free(ctx);
         return SIM_ERROR_HW_SIM;
     }
 
-    /* Initialize random number generator */
+    /* Initialize random number generator, used for link events */
     srand((unsigned int)time(NULL));
 
     /* Store context in the config structure */
@@ -148,6 +204,15 @@ sim_status_t sim_start(void *context) {
         return SIM_ERROR_THREAD;
     }
 
+    /* Traffic is generated on threads of its own */
+    sim_status_t status = sim_start_generators(ctx);
+    if (status != SIM_SUCCESS) {
+        ctx->is_running = false;
+        sim_thread_running = false;
+        pthread_join(sim_thread, NULL);
+        return status;
+    }
+
     LOG_INFO("Simulation started successfully");
     return SIM_SUCCESS;
 }
@@ -178,8 +243,9 @@ sim_status_t sim_stop(void *context) {
     ctx->is_running = false;
     sim_thread_running = false;
 
-    /* Wait for thread to terminate */
+    /* Wait for threads to terminate */
     pthread_join(sim_thread, NULL);
+    sim_stop_generators(ctx);
 
     LOG_INFO("Simulation stopped successfully");
     return SIM_SUCCESS;
@@ -216,6 +282,7 @@ sim_status_t sim_driver_shutdown(void *context) {
     }
 
     /* Free allocated resources */
+    free(ctx->profiles);
     free(ctx->port_status);
     free(ctx);
 
@@ -244,6 +311,7 @@ sim_status_t sim_configure(void *context, sim_config_t *config) {
     ctx->traffic_rate = config->traffic_rate > 0 ? 
                        config->traffic_rate : ctx->traffic_rate;
     ctx->link_flap_probability = config->link_flap_probability;
+    __atomic_add_fetch(&ctx->plan_generation, 1, __ATOMIC_RELEASE);
 
     LOG_INFO("Simulation configured: tick=%d ms, traffic_rate=%d pps, link_flap_prob=%f",
              ctx->tick_interval_ms, ctx->traffic_rate, ctx->link_flap_probability);
@@ -280,6 +348,7 @@ sim_status_t sim_set_port_state(void *context, uint32_t port_id, bool link_up) {
     if (link_callback != NULL) {
         link_callback(link_callback_context, port_id, link_up);
     }
+    link_event_report(port_id, link_up);
 
     return SIM_SUCCESS;
 }
@@ -305,13 +374,59 @@ sim_status_t sim_set_traffic_generation(void *context, uint32_t port_id, bool en
         return SIM_ERROR_INVALID_PORT;
     }
 
-    /* Update traffic generation state */
+    /* Update traffic generation state; the generators replan the offered load */
     ctx->port_status[port_id].traffic_enabled = enable;
+    __atomic_add_fetch(&ctx->plan_generation, 1, __ATOMIC_RELEASE);
 
     LOG_INFO("Traffic generation on port %u %s", port_id, enable ? "enabled" : "disabled");
     return SIM_SUCCESS;
 }
 
+/**
+ * Set the offered load of a port
+ *
+ * @param context Simulation context
+ * @param port_id Port identifier
+ * @param profile Offered load, NULL for the defaults
+ * @return SIM_SUCCESS on success, error code otherwise
+ */
+sim_status_t sim_set_traffic_profile(void *context, uint32_t port_id, const sim_traffic_profile_t *profile) {
+    if (context == NULL) {
+        LOG_ERROR("Failed to set traffic profile: NULL context");
+        return SIM_ERROR_INVALID_PARAM;
+    }
+
+    sim_context_t *ctx = (sim_context_t *)context;
+
+    if (port_id >= ctx->num_ports) {
+        LOG_ERROR("Failed to set traffic profile: Invalid port ID %u", port_id);
+        return SIM_ERROR_INVALID_PORT;
+    }
+
+    sim_traffic_profile_t new_profile = {0, 0, SIM_DST_RANDOM};
+    if (profile != NULL) {
+        new_profile = *profile;
+    }
+
+    if (new_profile.packet_size != 0 &&
+        (new_profile.packet_size < SIM_MIN_PACKET_SIZE || new_profile.packet_size > SIM_MAX_PACKET_SIZE)) {
+        LOG_ERROR("Failed to set traffic profile: Invalid packet size %u", new_profile.packet_size);
+        return SIM_ERROR_INVALID_PARAM;
+    }
+    if (new_profile.dst_port != SIM_DST_RANDOM && new_profile.dst_port >= ctx->num_ports) {
+        LOG_ERROR("Failed to set traffic profile: Invalid destination port %u", new_profile.dst_port);
+        return SIM_ERROR_INVALID_PORT;
+    }
+
+    /* Profiles change rarely; a generator reading one mid-update replans on the next bump */
+    ctx->profiles[port_id] = new_profile;
+    __atomic_add_fetch(&ctx->plan_generation, 1, __ATOMIC_RELEASE);
+
+    LOG_INFO("Traffic profile of port %u: %u pps, size %u", port_id,
+             new_profile.rate_pps, new_profile.packet_size);
+    return SIM_SUCCESS;
+}
+
 /**
  * Register packet handler callback
  *
@@ -438,7 +553,8 @@ sim_status_t sim_get_statistics(void *context, sim_statistics_t *stats) {
     sim_context_t *ctx = (sim_context_t *)context;
 
     /* Copy simulation statistics */
-    stats->packets_generated = ctx->stats.packets_generated;
+    stats->packets_generated = __atomic_load_n(&ctx->stats.packets_generated, __ATOMIC_RELAXED);
+    stats->bytes_generated = __atomic_load_n(&ctx->stats.bytes_generated, __ATOMIC_RELAXED);
     stats->packets_dropped = ctx->stats.packets_dropped;
     stats->link_state_changes = ctx->stats.link_state_changes;
     stats->running_time_ms = ctx->stats.running_time_ms;
@@ -519,9 +635,6 @@ static void *sim_worker_thread(void *arg) {
         uint64_t current_time = (uint64_t)time(NULL) * 1000;
         ctx->stats.running_time_ms = current_time - start_time;
         
-        /* Simulate network traffic */
-        simulate_traffic(ctx);
-        
         /* Simulate link state changes */
         simulate_link_events(ctx);
         
@@ -533,91 +646,6 @@ static void *sim_worker_thread(void *arg) {
     return NULL;
 }
 
-/**
- * Simulate network traffic
- *
- * @param ctx Simulation context
- */
-static void simulate_traffic(sim_context_t *ctx) {
-    /* Calculate how many packets to generate this tick */
-    uint32_t packets_per_tick = (ctx->traffic_rate * ctx->tick_interval_ms) / 1000;
-    
-    /* Ensure at least one packet if traffic_rate > 0 */
-    if (ctx->traffic_rate > 0 && packets_per_tick == 0) {
-        /* Generate packet probabilistically */
-        if ((rand() % 1000) < ((ctx->traffic_rate * ctx->tick_interval_ms) % 1000)) {
-            packets_per_tick = 1;
-        }
-    }
-    
-    /* Generate packets */
-    for (uint32_t i = 0; i < packets_per_tick; i++) {
-        /* Select source port with traffic enabled and link up */
-        uint32_t src_port = get_random_port_id(ctx);
-        if (src_port >= ctx->num_ports) {
-            /* No eligible source ports */
-            continue;
-        }
-        
-        if (!ctx->port_status[src_port].traffic_enabled || !ctx->port_status[src_port].link_up) {
-            continue;
-        }
-        
-        /* Select random destination port */
-        uint32_t dst_port;
-        do {
-            dst_port = rand() % ctx->num_ports;
-        } while (dst_port == src_port); /* Avoid sending to self */
-        
-        /* Generate random packet */
-        uint8_t packet[SIM_MAX_PACKET_SIZE];
-        size_t packet_size;
-        generate_random_packet(packet, &packet_size, src_port, dst_port);
-        
-        /* Increment stats */
-        ctx->stats.packets_generated++;
-        
-        /* Call packet handler if registered */
-        if (packet_callback != NULL) {
-            packet_callback(packet_callback_context, src_port, packet, packet_size);
-        }
-    }
-}
-
-/**
- * Generate a random Ethernet packet
- *
- * @param packet Buffer to store the packet
- * @param packet_size Pointer to store the packet size
- * @param src_port Source port ID
- * @param dst_port Destination port ID (for MAC address)
- */
-static void generate_random_packet(uint8_t *packet, size_t *packet_size, uint32_t src_port, uint32_t dst_port) {
-    /* Determine random packet size */
-    size_t size = SIM_MIN_PACKET_SIZE + rand() % (SIM_MAX_PACKET_SIZE - SIM_MIN_PACKET_SIZE + 1);
-    *packet_size = size;
-    
-    /* Clear packet buffer */
-    memset(packet, 0, size);
-    
-    /* Set destination MAC (use port's MAC) */
-    uint8_t dst_mac[SIM_MAC_ADDR_LEN] = {0x02, 0x00, 0x00, 0x00, (uint8_t)(dst_port >> 8), (uint8_t)dst_port};
-    memcpy(packet, dst_mac, SIM_MAC_ADDR_LEN);
-    
-    /* Set source MAC (use port's MAC) */
-    uint8_t src_mac[SIM_MAC_ADDR_LEN] = {0x02, 0x00, 0x00, 0x00, (uint8_t)(src_port >> 8), (uint8_t)src_port};
-    memcpy(packet + SIM_MAC_ADDR_LEN, src_mac, SIM_MAC_ADDR_LEN);
-    
-    /* Set EtherType (IPv4 = 0x0800) */
-    packet[12] = 0x08;
-    packet[13] = 0x00;
-    
-    /* Fill the rest with random data */
-    for (size_t i = 14; i < size; i++) {
-        packet[i] = (uint8_t)(rand() % 256);
-    }
-}
-
 /**
  * Simulate link state changes based on configuration
  *
@@ -646,41 +674,343 @@ static void simulate_link_events(sim_context_t *ctx) {
             if (link_callback != NULL) {
                 link_callback(link_callback_context, i, new_state);
             }
+            link_event_report(i, new_state);
         }
     }
 }
 
 /**
- * Get a random port ID with traffic enabled and link up
+ * Read the pacing clock
+ *
+ * The TSC on x86, the monotonic clock in nanoseconds elsewhere.
+ */
+static inline uint64_t sim_tsc_read(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * Measure the pacing clock rate against the monotonic clock
+ *
+ * @return Clock ticks per second
+ */
+static uint64_t sim_tsc_calibrate(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    struct timespec t0, t1;
+    struct timespec delay = {0, 20000000};  /* 20 ms */
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t c0 = __rdtsc();
+    nanosleep(&delay, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    uint64_t c1 = __rdtsc();
+
+    uint64_t ns = (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000ULL +
+                  (uint64_t)(t1.tv_nsec - t0.tv_nsec);
+    if (ns == 0 || c1 <= c0) {
+        return 1000000000ULL;
+    }
+    return (uint64_t)((double)(c1 - c0) * 1e9 / (double)ns);
+#else
+    return 1000000000ULL;
+#endif
+}
+
+/**
+ * Next pseudo-random number of a generator (xorshift64)
+ */
+static inline uint64_t sim_random(sim_generator_t *gen) {
+    uint64_t x = gen->rng;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    gen->rng = x;
+    return x;
+}
+
+/**
+ * Build the frames a port sends in turn
  *
+ * @param gen Generator owning the port
  * @param ctx Simulation context
- * @return Port ID or ctx->num_ports if no eligible port found
+ * @param port_id Source port
+ * @param gp Port generator state
  */
-static uint32_t get_random_port_id(sim_context_t *ctx) {
-    /* Count eligible ports */
-    uint32_t eligible_ports = 0;
+static void sim_build_templates(sim_generator_t *gen, sim_context_t *ctx,
+                                uint32_t port_id, sim_gen_port_t *gp) {
+    const sim_traffic_profile_t *profile = &ctx->profiles[port_id];
+
+    for (uint32_t t = 0; t < SIM_GEN_TEMPLATES; t++) {
+        uint8_t *frame = gp->templates + (size_t)t * SIM_MAX_PACKET_SIZE;
+        size_t size = profile->packet_size;
+        uint32_t dst_port = profile->dst_port;
+
+        if (size == 0) {
+            size = SIM_MIN_PACKET_SIZE + sim_random(gen) % (SIM_MAX_PACKET_SIZE - SIM_MIN_PACKET_SIZE + 1);
+        }
+        if (dst_port == SIM_DST_RANDOM) {
+            dst_port = port_id;
+            if (ctx->num_ports > 1) {
+                /* Any port but the source */
+                dst_port = (uint32_t)(sim_random(gen) % (ctx->num_ports - 1));
+                if (dst_port >= port_id) {
+                    dst_port++;
+                }
+            }
+        }
+        gp->sizes[t] = (uint16_t)size;
+
+        /* Destination and source MACs are the ports' MACs */
+        uint8_t dst_mac[SIM_MAC_ADDR_LEN] = {0x02, 0x00, 0x00, 0x00, (uint8_t)(dst_port >> 8), (uint8_t)dst_port};
+        uint8_t src_mac[SIM_MAC_ADDR_LEN] = {0x02, 0x00, 0x00, 0x00, (uint8_t)(port_id >> 8), (uint8_t)port_id};
+        memcpy(frame, dst_mac, SIM_MAC_ADDR_LEN);
+        memcpy(frame + SIM_MAC_ADDR_LEN, src_mac, SIM_MAC_ADDR_LEN);
+
+        /* EtherType IPv4, random payload */
+        frame[12] = 0x08;
+        frame[13] = 0x00;
+        for (size_t i = 14; i < size; i += 8) {
+            uint64_t r = sim_random(gen);
+            memcpy(frame + i, &r, size - i < 8 ? size - i : 8);
+        }
+    }
+    gp->next_template = 0;
+}
+
+/**
+ * Set the rate and templates of a generator's ports from the offered load
+ *
+ * Ports without a rate of their own split traffic_rate; the remainder
+ * goes to the first of them, so the shares add up to traffic_rate.
+ *
+ * @param gen Generator
+ * @param now_tsc Current time, when planned ports send first
+ */
+static void sim_plan_ports(sim_generator_t *gen, uint64_t now_tsc) {
+    sim_context_t *ctx = gen->ctx;
+    uint32_t shared_ports = 0;
+
+    gen->plan_generation = __atomic_load_n(&ctx->plan_generation, __ATOMIC_ACQUIRE);
+
     for (uint32_t i = 0; i < ctx->num_ports; i++) {
-        if (ctx->port_status[i].traffic_enabled && ctx->port_status[i].link_up) {
-            eligible_ports++;
+        if (ctx->port_status[i].traffic_enabled && ctx->profiles[i].rate_pps == 0) {
+            shared_ports++;
         }
     }
-    
-    if (eligible_ports == 0) {
-        return ctx->num_ports; /* No eligible ports */
+
+    uint32_t shared_rank = 0;
+    for (uint32_t i = 0; i < ctx->num_ports; i++) {
+        bool shared = ctx->port_status[i].traffic_enabled && ctx->profiles[i].rate_pps == 0;
+        uint32_t rank = shared ? shared_rank++ : 0;
+
+        if (i % ctx->num_generators != gen->index) {
+            continue;
+        }
+
+        sim_gen_port_t *gp = &sim_gen_ports[i];
+        uint32_t rate = 0;
+        if (ctx->port_status[i].traffic_enabled) {
+            rate = ctx->profiles[i].rate_pps;
+            if (shared) {
+                rate = ctx->traffic_rate / shared_ports + (rank < ctx->traffic_rate % shared_ports ? 1 : 0);
+            }
+        }
+
+        gp->rate_pps = rate;
+        if (rate == 0) {
+            continue;
+        }
+        gp->interval_tsc = sim_tsc_hz / rate;
+        gp->interval_rem = sim_tsc_hz % rate;
+        gp->rem_acc = 0;
+        gp->next_tsc = now_tsc;
+        sim_build_templates(gen, ctx, i, gp);
     }
-    
-    /* Select a random eligible port */
-    uint32_t selected = rand() % eligible_ports;
-    uint32_t count = 0;
-    
+}
+
+/**
+ * Traffic generator thread
+ *
+ * Sends every frame of its ports at its scheduled time, in bursts when
+ * behind, and sleeps or spins until the earliest next frame.
+ *
+ * @param arg Generator
+ * @return NULL when thread terminates
+ */
+static void *sim_generator_thread(void *arg) {
+    sim_generator_t *gen = (sim_generator_t *)arg;
+    sim_context_t *ctx = gen->ctx;
+    uint8_t frame[SIM_MAX_PACKET_SIZE];
+    uint64_t max_lag = sim_tsc_hz / 1000000 * SIM_GEN_MAX_LAG_US;
+    uint64_t spin = sim_tsc_hz / 1000000 * SIM_GEN_SPIN_US;
+
+    sim_plan_ports(gen, sim_tsc_read());
+
+    while (__atomic_load_n(&sim_thread_running, __ATOMIC_ACQUIRE)) {
+        if (__atomic_load_n(&ctx->plan_generation, __ATOMIC_ACQUIRE) != gen->plan_generation) {
+            sim_plan_ports(gen, sim_tsc_read());
+        }
+
+        uint64_t now = sim_tsc_read();
+        uint64_t earliest = UINT64_MAX;
+        uint64_t packets = 0;
+        uint64_t bytes = 0;
+
+        for (uint32_t i = gen->index; i < ctx->num_ports; i += ctx->num_generators) {
+            sim_gen_port_t *gp = &sim_gen_ports[i];
+            if (gp->rate_pps == 0) {
+                continue;
+            }
+
+            /* Too far behind to catch up: the backlog is not offered */
+            if (now > gp->next_tsc + max_lag) {
+                gp->next_tsc = now;
+                gp->rem_acc = 0;
+            }
+
+            bool link_up = __atomic_load_n(&ctx->port_status[i].link_up, __ATOMIC_RELAXED);
+            for (uint32_t n = 0; n < SIM_GEN_BURST && gp->next_tsc <= now; n++) {
+                if (link_up) {
+                    uint32_t t = gp->next_template;
+                    size_t size = gp->sizes[t];
+                    gp->next_template = (t + 1) % SIM_GEN_TEMPLATES;
+
+                    packets++;
+                    bytes += size;
+                    if (packet_callback != NULL) {
+                        /* The handler may modify its frame; the template stays intact */
+                        memcpy(frame, gp->templates + (size_t)t * SIM_MAX_PACKET_SIZE, size);
+                        packet_callback(packet_callback_context, i, frame, size);
+                    }
+                }
+
+                /* Advance by exactly 1/rate, carrying the fraction of a tick */
+                gp->next_tsc += gp->interval_tsc;
+                gp->rem_acc += gp->interval_rem;
+                if (gp->rem_acc >= gp->rate_pps) {
+                    gp->rem_acc -= gp->rate_pps;
+                    gp->next_tsc++;
+                }
+            }
+
+            if (gp->next_tsc < earliest) {
+                earliest = gp->next_tsc;
+            }
+        }
+
+        if (packets != 0) {
+            __atomic_fetch_add(&ctx->stats.packets_generated, packets, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&ctx->stats.bytes_generated, bytes, __ATOMIC_RELAXED);
+        }
+
+        /* Nothing to send: wait for the next frame or a change of plan */
+        now = sim_tsc_read();
+        if (earliest == UINT64_MAX) {
+            usleep(ctx->tick_interval_ms * 1000);
+        } else if (earliest > now + spin) {
+            uint64_t wait_us = (earliest - now - spin) * 1000000 / sim_tsc_hz;
+            usleep(wait_us < 100000 ? (useconds_t)wait_us : 100000);
+        } else if (earliest > now) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Start the traffic generator threads
+ *
+ * Port i belongs to generator i % num_generators.
+ *
+ * @param ctx Simulation context
+ * @return SIM_SUCCESS on success, error code otherwise
+ */
+static sim_status_t sim_start_generators(sim_context_t *ctx) {
+    uint32_t count = ctx->num_generators;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cpus < 1) {
+        cpus = 1;
+    }
+    if (sim_tsc_hz == 0) {
+        sim_tsc_hz = sim_tsc_calibrate();
+        LOG_INFO("Traffic pacing clock: %llu Hz", (unsigned long long)sim_tsc_hz);
+    }
+
     for (uint32_t i = 0; i < ctx->num_ports; i++) {
-        if (ctx->port_status[i].traffic_enabled && ctx->port_status[i].link_up) {
-            if (count == selected) {
-                return i;
+        sim_gen_port_t *gp = &sim_gen_ports[i];
+        memset(gp, 0, sizeof(*gp));
+        gp->templates = (uint8_t *)malloc((size_t)SIM_GEN_TEMPLATES * SIM_MAX_PACKET_SIZE);
+        if (gp->templates == NULL) {
+            LOG_ERROR("Failed to allocate packet templates for port %u", i);
+            sim_stop_generators(ctx);
+            return SIM_ERROR_MEMORY;
+        }
+    }
+
+    for (uint32_t g = 0; g < count; g++) {
+        sim_generator_t *gen = &sim_generators[g];
+        memset(gen, 0, sizeof(*gen));
+        gen->ctx = ctx;
+        gen->index = g;
+        gen->plan_generation = __atomic_load_n(&ctx->plan_generation, __ATOMIC_ACQUIRE);
+        gen->rng = ((uint64_t)time(NULL) << 16) ^ (0x9E3779B97F4A7C15ULL * (g + 1));
+
+        int rc = -1;
+        if (ctx->pin_generators) {
+            pthread_attr_t attr;
+            cpu_set_t set;
+
+            CPU_ZERO(&set);
+            CPU_SET((int)(g % (uint32_t)cpus), &set);
+            pthread_attr_init(&attr);
+            if (pthread_attr_setaffinity_np(&attr, sizeof(set), &set) == 0) {
+                rc = pthread_create(&gen->thread, &attr, sim_generator_thread, gen);
+            }
+            pthread_attr_destroy(&attr);
+            if (rc != 0) {
+                LOG_WARN("Failed to pin traffic generator %u", g);
             }
-            count++;
         }
+        if (rc != 0) {
+            rc = pthread_create(&gen->thread, NULL, sim_generator_thread, gen);
+        }
+        if (rc != 0) {
+            LOG_ERROR("Failed to create traffic generator thread %u: %d", g, rc);
+            __atomic_store_n(&sim_thread_running, false, __ATOMIC_RELEASE);
+            sim_stop_generators(ctx);
+            return SIM_ERROR_THREAD;
+        }
+        gen->started = true;
+    }
+
+    LOG_INFO("%u traffic generator threads started", count);
+    return SIM_SUCCESS;
+}
+
+/**
+ * Join the traffic generator threads and free their templates
+ *
+ * Called once sim_thread_running is cleared.
+ *
+ * @param ctx Simulation context
+ */
+static void sim_stop_generators(sim_context_t *ctx) {
+    for (uint32_t g = 0; g < SIM_MAX_GENERATORS; g++) {
+        if (sim_generators[g].started) {
+            pthread_join(sim_generators[g].thread, NULL);
+            sim_generators[g].started = false;
+        }
+    }
+    for (uint32_t i = 0; i < ctx->num_ports; i++) {
+        free(sim_gen_ports[i].templates);
+        sim_gen_ports[i].templates = NULL;
     }
-    
-    return ctx->num_ports; /* Should never reach here */
 }
@@ -0,0 +1,515 @@
+/**
+ * @file workload.c
+ * @brief Workload files, RX recording and the egress digest
+ *
+ * The writer appends pcapng blocks through a buffered stream under one
+ * mutex. An interface description block is written the first time a port
+ * records a frame, so the file lists only the ports that received
+ * anything and needs no port count up front.
+ *
+ * Digest drivers live in a static array and are never freed: after
+ * workload_digest_stop() a TX drain that already picked one up still
+ * finds it valid, and the sum is kept in relaxed atomics, as ports drain
+ * on their own threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "workload.h"
+#include "common/logging.h"
+#include "common/config.h"
+#include "hal/hw_resources.h"
+#include "hal/hw_simulation.h"
+#include "hal/packet.h"
+
+#define WORKLOAD_BLOCK_SHB          0x0A0D0D0A
+#define WORKLOAD_BLOCK_IDB          0x00000001
+#define WORKLOAD_BLOCK_EPB          0x00000006
+#define WORKLOAD_BYTE_ORDER_MAGIC   0x1A2B3C4D
+#define WORKLOAD_OPT_END            0
+#define WORKLOAD_OPT_COMMENT        1
+#define WORKLOAD_OPT_IF_NAME        2
+#define WORKLOAD_OPT_SHB_USERAPPL   4
+#define WORKLOAD_OPT_IF_TSRESOL     9
+#define WORKLOAD_OPT_MAX_LEN        65532       /* Longest option kept 4-byte aligned */
+#define WORKLOAD_LINKTYPE_ETHERNET  1
+#define WORKLOAD_SNAPLEN            262144
+#define WORKLOAD_STREAM_BUFFER      (1u << 20)
+
+#define WORKLOAD_FNV_OFFSET         0xcbf29ce484222325ULL
+#define WORKLOAD_FNV_PRIME          0x100000001b3ULL
+
+struct workload_writer {
+    pthread_mutex_t lock;
+    FILE *file;
+    char *buffer;                   /* Stream buffer */
+    bool failed;                    /* A write fell short */
+    uint32_t if_count;
+    uint32_t if_id[CONFIG_MAX_PORTS];   /* Interface of each port plus one, 0 for none yet */
+    uint64_t packets;
+};
+
+/* Digest driver of one port */
+typedef struct {
+    driver_t base;                  /* First, so the digest is a driver_t */
+    driver_handle_t next;           /* Driver it stands in front of, NULL for none */
+    port_id_t port;
+} workload_digest_port_t;
+
+static struct {
+    pthread_mutex_t lock;           /* Recording start and stop */
+    workload_writer_t *writer;      /* While recording */
+    uint64_t origin_ns;             /* Recording start */
+} g_workload_record = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static struct {
+    pthread_mutex_t lock;           /* Start and stop */
+    bool running;
+    uint32_t port_count;
+    workload_digest_t digest;
+    workload_digest_port_t ports[CONFIG_MAX_PORTS];
+} g_workload_digest = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static uint64_t workload_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* ---------------------------------------------------------------------------
+ * Writer
+ * ------------------------------------------------------------------------- */
+
+static void workload_put(workload_writer_t *writer, const void *data, size_t len) {
+    if (len > 0 && fwrite(data, 1, len, writer->file) != len) {
+        writer->failed = true;
+    }
+}
+
+static void workload_put32(workload_writer_t *writer, uint32_t value) {
+    workload_put(writer, &value, sizeof(value));
+}
+
+static void workload_pad(workload_writer_t *writer, size_t len) {
+    static const uint8_t zero[4];
+    workload_put(writer, zero, (4 - (len & 3)) & 3);
+}
+
+/**
+ * @brief Bytes an option takes in a block
+ */
+static uint32_t workload_opt_len(size_t len) {
+    return 4 + (((uint32_t)len + 3u) & ~3u);
+}
+
+static void workload_put_opt(workload_writer_t *writer, uint16_t code, const void *value, size_t len) {
+    uint16_t hdr[2] = { code, (uint16_t)len };
+
+    workload_put(writer, hdr, sizeof(hdr));
+    workload_put(writer, value, len);
+    workload_pad(writer, len);
+}
+
+/**
+ * @brief Write the section header; long configurations span several comments
+ */
+static void workload_put_shb(workload_writer_t *writer, const char *config) {
+    size_t config_len = config ? strlen(config) : 0;
+    size_t appl_len = strlen(WORKLOAD_USER_APPL);
+    uint32_t total = 28 + workload_opt_len(appl_len) + 4;
+    uint64_t section_len = UINT64_MAX;
+    uint16_t version[2] = { 1, 0 };
+
+    for (size_t off = 0; off < config_len; off += WORKLOAD_OPT_MAX_LEN) {
+        size_t len = config_len - off < WORKLOAD_OPT_MAX_LEN ? config_len - off : WORKLOAD_OPT_MAX_LEN;
+        total += workload_opt_len(len);
+    }
+
+    workload_put32(writer, WORKLOAD_BLOCK_SHB);
+    workload_put32(writer, total);
+    workload_put32(writer, WORKLOAD_BYTE_ORDER_MAGIC);
+    workload_put(writer, version, sizeof(version));
+    workload_put(writer, &section_len, sizeof(section_len));
+    workload_put_opt(writer, WORKLOAD_OPT_SHB_USERAPPL, WORKLOAD_USER_APPL, appl_len);
+    for (size_t off = 0; off < config_len; off += WORKLOAD_OPT_MAX_LEN) {
+        size_t len = config_len - off < WORKLOAD_OPT_MAX_LEN ? config_len - off : WORKLOAD_OPT_MAX_LEN;
+        workload_put_opt(writer, WORKLOAD_OPT_COMMENT, config + off, len);
+    }
+    workload_put32(writer, WORKLOAD_OPT_END);
+    workload_put32(writer, total);
+}
+
+/**
+ * @brief Interface of a port, describing it first if it has none yet
+ */
+static uint32_t workload_interface(workload_writer_t *writer, port_id_t port) {
+    char name[16];
+    uint16_t linktype[2] = { WORKLOAD_LINKTYPE_ETHERNET, 0 };  /* And two reserved bytes */
+    uint8_t tsresol = 9;                                        /* Nanoseconds */
+
+    if (writer->if_id[port] != 0) {
+        return writer->if_id[port] - 1;
+    }
+
+    int name_len = snprintf(name, sizeof(name), "port%u", port);
+    uint32_t total = 20 + workload_opt_len((size_t)name_len) + workload_opt_len(1) + 4;
+    workload_put32(writer, WORKLOAD_BLOCK_IDB);
+    workload_put32(writer, total);
+    workload_put(writer, linktype, sizeof(linktype));
+    workload_put32(writer, WORKLOAD_SNAPLEN);
+    workload_put_opt(writer, WORKLOAD_OPT_IF_NAME, name, (size_t)name_len);
+    workload_put_opt(writer, WORKLOAD_OPT_IF_TSRESOL, &tsresol, 1);
+    workload_put32(writer, WORKLOAD_OPT_END);
+    workload_put32(writer, total);
+
+    writer->if_id[port] = ++writer->if_count;
+    return writer->if_count - 1;
+}
+
+/**
+ * @brief Write the front of an enhanced packet block; the frame and workload_put_epb_end() follow
+ */
+static void workload_put_epb(workload_writer_t *writer, port_id_t port, uint64_t time_ns, uint32_t len) {
+    uint32_t if_id = workload_interface(writer, port);
+    uint32_t hdr[7] = {
+        WORKLOAD_BLOCK_EPB, 32 + ((len + 3u) & ~3u), if_id,
+        (uint32_t)(time_ns >> 32), (uint32_t)time_ns, len, len,
+    };
+
+    workload_put(writer, hdr, sizeof(hdr));
+}
+
+static void workload_put_epb_end(workload_writer_t *writer, uint32_t len) {
+    workload_pad(writer, len);
+    workload_put32(writer, 32 + ((len + 3u) & ~3u));
+    writer->packets++;
+}
+
+/**
+ * @brief Create a workload file
+ *
+ * @param path File to create
+ * @param config Configuration of the run as JSON, NULL for none
+ * @param[out] writer New writer
+ * @return STATUS_SUCCESS on success, error code otherwise
+ */
+status_t workload_writer_open(const char *path, const char *config, workload_writer_t **writer) {
+    if (!path || !writer) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    workload_writer_t *w = calloc(1, sizeof(*w));
+    if (!w) {
+        return STATUS_NO_MEMORY;
+    }
+    w->buffer = malloc(WORKLOAD_STREAM_BUFFER);
+    if (!w->buffer) {
+        free(w);
+        return STATUS_NO_MEMORY;
+    }
+    w->file = fopen(path, "wb");
+    if (!w->file) {
+        LOG_ERROR(LOG_CATEGORY_DRIVER, "Cannot create workload %s: %s", path, strerror(errno));
+        free(w->buffer);
+        free(w);
+        return STATUS_FAILURE;
+    }
+    setvbuf(w->file, w->buffer, _IOFBF, WORKLOAD_STREAM_BUFFER);
+    pthread_mutex_init(&w->lock, NULL);
+
+    workload_put_shb(w, config);
+    *writer = w;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Append a frame; calls from several threads are serialized
+ *
+ * @param writer Writer
+ * @param port Ingress port
+ * @param time_ns Arrival time, nanoseconds from any fixed origin
+ * @param data Frame
+ * @param len Frame length
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t workload_writer_add(workload_writer_t *writer, port_id_t port, uint64_t time_ns,
+                             const uint8_t *data, uint32_t len) {
+    if (!writer || port >= CONFIG_MAX_PORTS || (!data && len > 0) || len > WORKLOAD_SNAPLEN) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    workload_put_epb(writer, port, time_ns, len);
+    workload_put(writer, data, len);
+    workload_put_epb_end(writer, len);
+    pthread_mutex_unlock(&writer->lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Flush and close a workload file
+ *
+ * @param writer Writer, may be NULL
+ * @return STATUS_SUCCESS, STATUS_FAILURE if any write failed
+ */
+status_t workload_writer_close(workload_writer_t *writer) {
+    if (!writer) {
+        return STATUS_SUCCESS;
+    }
+
+    bool failed = writer->failed;
+    if (fclose(writer->file) != 0) {
+        failed = true;
+    }
+    if (failed) {
+        LOG_ERROR(LOG_CATEGORY_DRIVER, "Workload write failed, the file is incomplete");
+    }
+    pthread_mutex_destroy(&writer->lock);
+    free(writer->buffer);
+    free(writer);
+    return failed ? STATUS_FAILURE : STATUS_SUCCESS;
+}
+
+/* ---------------------------------------------------------------------------
+ * Recording
+ * ------------------------------------------------------------------------- */
+
+/**
+ * @brief RX tap: one record per frame, segment by segment
+ */
+static void workload_record_tap(port_id_t port_id, packet_buffer_t *const *pkts, uint32_t count,
+                                void *user_data) {
+    (void)user_data;
+
+    pthread_mutex_lock(&g_workload_record.lock);
+    workload_writer_t *writer = g_workload_record.writer;
+    if (writer && port_id < CONFIG_MAX_PORTS) {
+        uint64_t time_ns = workload_now_ns() - g_workload_record.origin_ns;
+
+        pthread_mutex_lock(&writer->lock);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t len = packet_chain_length(pkts[i]);
+            if (len > WORKLOAD_SNAPLEN) {
+                continue;
+            }
+            workload_put_epb(writer, port_id, time_ns, len);
+            for (const packet_buffer_t *seg = pkts[i]; seg; seg = seg->next) {
+                workload_put(writer, seg->data, seg->length);
+            }
+            workload_put_epb_end(writer, len);
+        }
+        pthread_mutex_unlock(&writer->lock);
+    }
+    pthread_mutex_unlock(&g_workload_record.lock);
+}
+
+/**
+ * @brief Record every frame the ports receive from now on
+ *
+ * @param path File to create
+ * @param config Configuration of the run as JSON, NULL for none
+ * @return STATUS_SUCCESS on success, error code otherwise
+ */
+status_t workload_record_start(const char *path, const char *config) {
+    workload_writer_t *writer;
+    status_t status;
+
+    pthread_mutex_lock(&g_workload_record.lock);
+    if (g_workload_record.writer) {
+        pthread_mutex_unlock(&g_workload_record.lock);
+        return STATUS_ALREADY_INITIALIZED;
+    }
+    status = workload_writer_open(path, config, &writer);
+    if (status == STATUS_SUCCESS) {
+        g_workload_record.writer = writer;
+        g_workload_record.origin_ns = workload_now_ns();
+    }
+    pthread_mutex_unlock(&g_workload_record.lock);
+
+    if (status == STATUS_SUCCESS) {
+        hw_sim_set_rx_tap(workload_record_tap, NULL);
+        LOG_INFO(LOG_CATEGORY_DRIVER, "Recording the workload to %s", path);
+    }
+    return status;
+}
+
+/**
+ * @brief Stop recording and close the file
+ *
+ * @param[out] packets Frames recorded, may be NULL
+ * @return STATUS_SUCCESS, STATUS_NOT_INITIALIZED if not recording,
+ *         STATUS_FAILURE if any write failed
+ */
+status_t workload_record_stop(uint64_t *packets) {
+    hw_sim_set_rx_tap(NULL, NULL);
+
+    /* A tap still running holds the lock and finishes before the file closes */
+    pthread_mutex_lock(&g_workload_record.lock);
+    workload_writer_t *writer = g_workload_record.writer;
+    g_workload_record.writer = NULL;
+    pthread_mutex_unlock(&g_workload_record.lock);
+
+    if (!writer) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (packets) {
+        *packets = writer->packets;
+    }
+    LOG_INFO(LOG_CATEGORY_DRIVER, "Workload recorded: %llu frames on %u ports",
+             (unsigned long long)writer->packets, writer->if_count);
+    return workload_writer_close(writer);
+}
+
+/* ---------------------------------------------------------------------------
+ * Digest
+ * ------------------------------------------------------------------------- */
+
+/**
+ * @brief Hash of a frame and its port, FNV-1a folded through a finalizer
+ *
+ * The finalizer spreads the bits, so that sums of hashes of similar
+ * frames do not cancel out.
+ */
+static uint64_t workload_frame_hash(port_id_t port, const packet_t *pkt) {
+    uint64_t h = WORKLOAD_FNV_OFFSET;
+
+    for (const packet_t *seg = pkt; seg; seg = seg->next) {
+        for (uint32_t i = 0; i < seg->length; i++) {
+            h = (h ^ seg->data[i]) * WORKLOAD_FNV_PRIME;
+        }
+    }
+    h ^= (uint64_t)port * 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+static uint16_t workload_digest_transmit_burst(driver_t *drv, packet_t **pkts, uint16_t n) {
+    workload_digest_port_t *dp = (workload_digest_port_t *)drv;
+    uint64_t value = 0;
+    uint64_t bytes = 0;
+
+    for (uint16_t i = 0; i < n; i++) {
+        value += workload_frame_hash(dp->port, pkts[i]);
+        bytes += packet_chain_length(pkts[i]);
+    }
+    __atomic_fetch_add(&g_workload_digest.digest.value, value, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_workload_digest.digest.bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_workload_digest.digest.packets, n, __ATOMIC_RELAXED);
+
+    if (dp->next) {
+        return driver_transmit_burst(dp->next, pkts, n);
+    }
+    return (uint16_t)hw_sim_transmit_burst(dp->port, pkts, n);
+}
+
+static status_t workload_digest_transmit(driver_t *drv, packet_t *pkt) {
+    return workload_digest_transmit_burst(drv, &pkt, 1) == 1 ? STATUS_SUCCESS : STATUS_FAILURE;
+}
+
+static status_t workload_digest_noop(driver_t *drv) {
+    (void)drv;
+    return STATUS_SUCCESS;
+}
+
+static const driver_ops_t g_workload_digest_ops = {
+    .init = workload_digest_noop,
+    .transmit = workload_digest_transmit,
+    .shutdown = workload_digest_noop,
+    .transmit_burst = workload_digest_transmit_burst,
+};
+
+/**
+ * @brief Start digesting the egress of every port
+ *
+ * @return STATUS_SUCCESS on success, STATUS_ALREADY_INITIALIZED if
+ *         started, error code otherwise
+ */
+status_t workload_digest_start(void) {
+    uint32_t port_count;
+    status_t status;
+
+    pthread_mutex_lock(&g_workload_digest.lock);
+    if (g_workload_digest.running) {
+        pthread_mutex_unlock(&g_workload_digest.lock);
+        return STATUS_ALREADY_INITIALIZED;
+    }
+    status = hw_sim_get_port_count(&port_count);
+    if (status != STATUS_SUCCESS) {
+        pthread_mutex_unlock(&g_workload_digest.lock);
+        return status;
+    }
+    if (port_count > CONFIG_MAX_PORTS) {
+        port_count = CONFIG_MAX_PORTS;
+    }
+
+    __atomic_store_n(&g_workload_digest.digest.packets, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_workload_digest.digest.bytes, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_workload_digest.digest.value, 0, __ATOMIC_RELAXED);
+
+    for (uint32_t port = 0; port < port_count; port++) {
+        workload_digest_port_t *dp = &g_workload_digest.ports[port];
+        port_config_t port_config;
+
+        if (hw_sim_get_port_config((port_id_t)port, &port_config) != STATUS_SUCCESS) {
+            continue;
+        }
+        dp->base.ops = &g_workload_digest_ops;
+        dp->base.drv_type = DRIVER_TYPE_VIRTUAL;
+        dp->base.flags = DRIVER_FLAG_TX_CAPABLE |
+                         (hw_sim_get_port_offloads((port_id_t)port) & DRIVER_FLAGS_OFFLOAD);
+        snprintf(dp->base.name, sizeof(dp->base.name), "digest%u", port);
+        dp->port = (port_id_t)port;
+        dp->next = port_config.driver;
+        port_config.driver = &dp->base;
+        if (hw_sim_set_port_config((port_id_t)port, &port_config) != STATUS_SUCCESS) {
+            LOG_WARNING(LOG_CATEGORY_DRIVER, "Egress of port %u is left out of the digest", port);
+        }
+    }
+    g_workload_digest.port_count = port_count;
+    g_workload_digest.running = true;
+    pthread_mutex_unlock(&g_workload_digest.lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Read the digest so far
+ *
+ * @param[out] digest Digest
+ */
+void workload_digest_get(workload_digest_t *digest) {
+    if (!digest) {
+        return;
+    }
+    digest->packets = __atomic_load_n(&g_workload_digest.digest.packets, __ATOMIC_RELAXED);
+    digest->bytes = __atomic_load_n(&g_workload_digest.digest.bytes, __ATOMIC_RELAXED);
+    digest->value = __atomic_load_n(&g_workload_digest.digest.value, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Put back the egress drivers the digest stood in front of
+ */
+void workload_digest_stop(void) {
+    pthread_mutex_lock(&g_workload_digest.lock);
+    if (g_workload_digest.running) {
+        for (uint32_t port = 0; port < g_workload_digest.port_count; port++) {
+            workload_digest_port_t *dp = &g_workload_digest.ports[port];
+            port_config_t port_config;
+
+            /* Left alone if something else took the port since */
+            if (hw_sim_get_port_config((port_id_t)port, &port_config) == STATUS_SUCCESS &&
+                port_config.driver == &dp->base) {
+                port_config.driver = dp->next;
+                hw_sim_set_port_config((port_id_t)port, &port_config);
+            }
+        }
+        g_workload_digest.running = false;
+    }
+    pthread_mutex_unlock(&g_workload_digest.lock);
+}
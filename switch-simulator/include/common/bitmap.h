@@ -0,0 +1,250 @@
+/**
+ * @file bitmap.h
+ * @brief Word-packed bitmaps of ports, VLANs and other small IDs
+ *
+ * A bitmap is a plain array of 64-bit words, bit n in word n / 64, so the
+ * port and VLAN bitmaps declared elsewhere (vlan_port_bitmap_t, the VLAN
+ * ID bitmaps, link event batches) are used as they are. Every operation
+ * takes the number of words; with the constant word counts of those
+ * types the loops are unrolled at compile time.
+ *
+ * Set operations run 256 bits at a time with AVX2 when the build targets
+ * it, so a port bitmap of 256 ports is a single instruction; otherwise
+ * they are plain word loops left to the compiler's vectorizer. Counting
+ * uses the population count of each word, and walking the set bits costs
+ * one count-trailing-zeros per bit, not one test per port.
+ */
+
+#ifndef SWITCH_SIM_BITMAP_H
+#define SWITCH_SIM_BITMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/** Number of 64-bit words in a bitmap of bits IDs */
+#define BITMAP_WORDS(bits) (((bits) + 63) / 64)
+
+/** No set bit, returned by bitmap_next() */
+#define BITMAP_NONE UINT32_MAX
+
+/**
+ * @brief Walk the set bits of a bitmap in ascending order
+ *
+ * The bitmap is read as the walk goes: bits above the current one that
+ * the body sets or clears are seen.
+ *
+ * @param bit Name of the uint32_t loop variable the macro declares
+ * @param map Bitmap
+ * @param words Words in the bitmap
+ */
+#define BITMAP_FOR_EACH(bit, map, words)                                     \
+    for (uint32_t bit = bitmap_next((map), (words), 0); bit != BITMAP_NONE;  \
+         bit = bitmap_next((map), (words), bit + 1))
+
+static inline void bitmap_set(uint64_t *map, uint32_t bit) {
+    map[bit / 64] |= 1ULL << (bit % 64);
+}
+
+static inline void bitmap_clear(uint64_t *map, uint32_t bit) {
+    map[bit / 64] &= ~(1ULL << (bit % 64));
+}
+
+static inline bool bitmap_test(const uint64_t *map, uint32_t bit) {
+    return (map[bit / 64] >> (bit % 64)) & 1;
+}
+
+/**
+ * @brief Set or clear one bit
+ *
+ * @return true if the bit changed
+ */
+static inline bool bitmap_assign(uint64_t *map, uint32_t bit, bool value) {
+    uint64_t old = map[bit / 64];
+    uint64_t mask = 1ULL << (bit % 64);
+    map[bit / 64] = value ? old | mask : old & ~mask;
+    return ((old & mask) != 0) != value;
+}
+
+static inline void bitmap_zero(uint64_t *map, uint32_t words) {
+    for (uint32_t w = 0; w < words; w++) {
+        map[w] = 0;
+    }
+}
+
+/**
+ * @brief Set bits 0 to bits - 1 and clear the rest
+ */
+static inline void bitmap_fill(uint64_t *map, uint32_t words, uint32_t bits) {
+    for (uint32_t w = 0; w < words; w++) {
+        if (bits >= (w + 1) * 64) {
+            map[w] = ~0ULL;
+        } else if (bits > w * 64) {
+            map[w] = (1ULL << (bits - w * 64)) - 1;
+        } else {
+            map[w] = 0;
+        }
+    }
+}
+
+static inline void bitmap_copy(uint64_t *dst, const uint64_t *src, uint32_t words) {
+    for (uint32_t w = 0; w < words; w++) {
+        dst[w] = src[w];
+    }
+}
+
+/*
+ * Binary set operations, dst = a op b. dst may be a or b. With AVX2 the
+ * words are taken four at a time and the rest one at a time.
+ */
+#if defined(__AVX2__)
+#define BITMAP_BINARY_OP(name, vector_op, scalar_expr)                                  \
+static inline void name(uint64_t *dst, const uint64_t *a, const uint64_t *b, uint32_t words) { \
+    uint32_t w = 0;                                                                     \
+    for (; w + 4 <= words; w += 4) {                                                    \
+        __m256i x = _mm256_loadu_si256((const __m256i *)&a[w]);                         \
+        __m256i y = _mm256_loadu_si256((const __m256i *)&b[w]);                         \
+        _mm256_storeu_si256((__m256i *)&dst[w], vector_op);                             \
+    }                                                                                   \
+    for (; w < words; w++) {                                                            \
+        dst[w] = scalar_expr;                                                           \
+    }                                                                                   \
+}
+#else
+#define BITMAP_BINARY_OP(name, vector_op, scalar_expr)                                  \
+static inline void name(uint64_t *dst, const uint64_t *a, const uint64_t *b, uint32_t words) { \
+    for (uint32_t w = 0; w < words; w++) {                                              \
+        dst[w] = scalar_expr;                                                           \
+    }                                                                                   \
+}
+#endif
+
+/** dst = a & b */
+BITMAP_BINARY_OP(bitmap_and, _mm256_and_si256(x, y), a[w] & b[w])
+/** dst = a | b */
+BITMAP_BINARY_OP(bitmap_or, _mm256_or_si256(x, y), a[w] | b[w])
+/** dst = a & ~b */
+BITMAP_BINARY_OP(bitmap_andnot, _mm256_andnot_si256(y, x), a[w] & ~b[w])
+
+#undef BITMAP_BINARY_OP
+
+/**
+ * @brief dst = a & b & c, in one pass
+ */
+static inline void bitmap_and3(uint64_t *dst, const uint64_t *a, const uint64_t *b,
+                               const uint64_t *c, uint32_t words) {
+    uint32_t w = 0;
+#if defined(__AVX2__)
+    for (; w + 4 <= words; w += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)&a[w]);
+        __m256i y = _mm256_loadu_si256((const __m256i *)&b[w]);
+        __m256i z = _mm256_loadu_si256((const __m256i *)&c[w]);
+        _mm256_storeu_si256((__m256i *)&dst[w], _mm256_and_si256(_mm256_and_si256(x, y), z));
+    }
+#endif
+    for (; w < words; w++) {
+        dst[w] = a[w] & b[w] & c[w];
+    }
+}
+
+static inline bool bitmap_empty(const uint64_t *map, uint32_t words) {
+    uint32_t w = 0;
+    uint64_t any = 0;
+#if defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+    for (; w + 4 <= words; w += 4) {
+        acc = _mm256_or_si256(acc, _mm256_loadu_si256((const __m256i *)&map[w]));
+    }
+    any = (uint64_t)!_mm256_testz_si256(acc, acc);
+#endif
+    for (; w < words; w++) {
+        any |= map[w];
+    }
+    return any == 0;
+}
+
+/**
+ * @brief Whether a and b have a bit in common
+ */
+static inline bool bitmap_intersects(const uint64_t *a, const uint64_t *b, uint32_t words) {
+    uint32_t w = 0;
+    uint64_t any = 0;
+#if defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+    for (; w + 4 <= words; w += 4) {
+        acc = _mm256_or_si256(acc, _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&a[w]),
+                                                    _mm256_loadu_si256((const __m256i *)&b[w])));
+    }
+    any = (uint64_t)!_mm256_testz_si256(acc, acc);
+#endif
+    for (; w < words; w++) {
+        any |= a[w] & b[w];
+    }
+    return any != 0;
+}
+
+static inline bool bitmap_equal(const uint64_t *a, const uint64_t *b, uint32_t words) {
+    uint64_t diff = 0;
+    for (uint32_t w = 0; w < words; w++) {
+        diff |= a[w] ^ b[w];
+    }
+    return diff == 0;
+}
+
+/**
+ * @brief Number of set bits
+ */
+static inline uint32_t bitmap_count(const uint64_t *map, uint32_t words) {
+    uint32_t count = 0;
+    for (uint32_t w = 0; w < words; w++) {
+        count += (uint32_t)__builtin_popcountll(map[w]);
+    }
+    return count;
+}
+
+/**
+ * @brief Number of bits set in both a and b
+ */
+static inline uint32_t bitmap_count_and(const uint64_t *a, const uint64_t *b, uint32_t words) {
+    uint32_t count = 0;
+    for (uint32_t w = 0; w < words; w++) {
+        count += (uint32_t)__builtin_popcountll(a[w] & b[w]);
+    }
+    return count;
+}
+
+/**
+ * @brief Lowest set bit at or above from
+ *
+ * @return The bit, or BITMAP_NONE if there is none
+ */
+static inline uint32_t bitmap_next(const uint64_t *map, uint32_t words, uint32_t from) {
+    uint32_t w = from / 64;
+    if (w >= words) {
+        return BITMAP_NONE;
+    }
+    uint64_t bits = map[w] & (~0ULL << (from % 64));
+    while (bits == 0) {
+        if (++w == words) {
+            return BITMAP_NONE;
+        }
+        bits = map[w];
+    }
+    return w * 64 + (uint32_t)__builtin_ctzll(bits);
+}
+
+/**
+ * @brief List the set bits of a bitmap in ascending order
+ *
+ * @param map Bitmap
+ * @param words Words in the bitmap
+ * @param[out] list IDs of the set bits
+ * @param max Size of list
+ * @return Number of IDs stored, at most max
+ */
+uint32_t bitmap_collect(const uint64_t *map, uint32_t words, uint16_t *list, uint32_t max);
+
+#endif /* SWITCH_SIM_BITMAP_H */
@@ -0,0 +1,20 @@
+/**
+ * @file datacenter.h
+ * @brief Build profile of the 64-port datacenter switch board (BSP_BOARD_TYPE_DATACENTER)
+ *
+ * Selected with CONFIG_BOARD_PROFILE (make BOARD=datacenter). Port IDs are the
+ * 64 front-panel ports, then 32 VXLAN tunnels and 32 LAGs: 128 in all,
+ * so port bitmaps are 2 words. The MAC table holds the board's hash
+ * banks (bsp_config.c).
+ */
+#ifndef SWITCH_SIM_BOARD_DATACENTER_H
+#define SWITCH_SIM_BOARD_DATACENTER_H
+
+#define CONFIG_BOARD_TYPE                   BSP_BOARD_TYPE_DATACENTER
+#define CONFIG_MAX_PORTS                    128
+#define CONFIG_DEFAULT_PORT_COUNT           64
+#define CONFIG_VXLAN_MAX_TUNNELS            32
+#define CONFIG_MAX_LAGS                     32
+#define CONFIG_MAX_MAC_TABLE_ENTRIES        65536
+
+#endif /* SWITCH_SIM_BOARD_DATACENTER_H */
@@ -0,0 +1,20 @@
+/**
+ * @file enterprise.h
+ * @brief Build profile of the 32-port enterprise switch board (BSP_BOARD_TYPE_ENTERPRISE)
+ *
+ * Selected with CONFIG_BOARD_PROFILE (make BOARD=enterprise). Port IDs are the
+ * 32 front-panel ports, then 16 VXLAN tunnels and 16 LAGs: 64 in all,
+ * so port bitmaps are 1 word. The MAC table holds the board's hash
+ * banks (bsp_config.c).
+ */
+#ifndef SWITCH_SIM_BOARD_ENTERPRISE_H
+#define SWITCH_SIM_BOARD_ENTERPRISE_H
+
+#define CONFIG_BOARD_TYPE                   BSP_BOARD_TYPE_ENTERPRISE
+#define CONFIG_MAX_PORTS                    64
+#define CONFIG_DEFAULT_PORT_COUNT           32
+#define CONFIG_VXLAN_MAX_TUNNELS            16
+#define CONFIG_MAX_LAGS                     16
+#define CONFIG_MAX_MAC_TABLE_ENTRIES        65536
+
+#endif /* SWITCH_SIM_BOARD_ENTERPRISE_H */
@@ -0,0 +1,20 @@
+/**
+ * @file large.h
+ * @brief Build profile of the 48-port large switch board (BSP_BOARD_TYPE_LARGE)
+ *
+ * Selected with CONFIG_BOARD_PROFILE (make BOARD=large). Port IDs are the
+ * 48 front-panel ports, then 8 VXLAN tunnels and 8 LAGs: 64 in all,
+ * so port bitmaps are 1 word. The MAC table holds the board's hash
+ * banks (bsp_config.c).
+ */
+#ifndef SWITCH_SIM_BOARD_LARGE_H
+#define SWITCH_SIM_BOARD_LARGE_H
+
+#define CONFIG_BOARD_TYPE                   BSP_BOARD_TYPE_LARGE
+#define CONFIG_MAX_PORTS                    64
+#define CONFIG_DEFAULT_PORT_COUNT           48
+#define CONFIG_VXLAN_MAX_TUNNELS            8
+#define CONFIG_MAX_LAGS                     8
+#define CONFIG_MAX_MAC_TABLE_ENTRIES        32768
+
+#endif /* SWITCH_SIM_BOARD_LARGE_H */
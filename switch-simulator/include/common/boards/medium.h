@@ -0,0 +1,20 @@
+/**
+ * @file medium.h
+ * @brief Build profile of the 24-port medium switch board (BSP_BOARD_TYPE_MEDIUM)
+ *
+ * Selected with CONFIG_BOARD_PROFILE (make BOARD=medium). Port IDs are the
+ * 24 front-panel ports, then 4 VXLAN tunnels and 4 LAGs: 32 in all,
+ * so port bitmaps are 1 word. The MAC table holds the board's hash
+ * banks (bsp_config.c).
+ */
+#ifndef SWITCH_SIM_BOARD_MEDIUM_H
+#define SWITCH_SIM_BOARD_MEDIUM_H
+
+#define CONFIG_BOARD_TYPE                   BSP_BOARD_TYPE_MEDIUM
+#define CONFIG_MAX_PORTS                    32
+#define CONFIG_DEFAULT_PORT_COUNT           24
+#define CONFIG_VXLAN_MAX_TUNNELS            4
+#define CONFIG_MAX_LAGS                     4
+#define CONFIG_MAX_MAC_TABLE_ENTRIES        16384
+
+#endif /* SWITCH_SIM_BOARD_MEDIUM_H */
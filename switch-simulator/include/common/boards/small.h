@@ -0,0 +1,20 @@
+/**
+ * @file small.h
+ * @brief Build profile of the 8-port small switch board (BSP_BOARD_TYPE_SMALL)
+ *
+ * Selected with CONFIG_BOARD_PROFILE (make BOARD=small). Port IDs are the
+ * 8 front-panel ports, then 4 VXLAN tunnels and 4 LAGs: 16 in all,
+ * so port bitmaps are 1 word. The MAC table holds the board's hash
+ * banks (bsp_config.c).
+ */
+#ifndef SWITCH_SIM_BOARD_SMALL_H
+#define SWITCH_SIM_BOARD_SMALL_H
+
+#define CONFIG_BOARD_TYPE                   BSP_BOARD_TYPE_SMALL
+#define CONFIG_MAX_PORTS                    16
+#define CONFIG_DEFAULT_PORT_COUNT           8
+#define CONFIG_VXLAN_MAX_TUNNELS            4
+#define CONFIG_MAX_LAGS                     4
+#define CONFIG_MAX_MAC_TABLE_ENTRIES        8192
+
+#endif /* SWITCH_SIM_BOARD_SMALL_H */
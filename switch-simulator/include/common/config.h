@@ -17,12 +17,31 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-
+/**
+ * @brief Board build profile
+ *
+ * A build for one board defines CONFIG_BOARD_PROFILE as the header of its
+ * profile (common/boards/<board>.h, make BOARD=<board>). The profile sets
+ * the port count and table sizes of that board ahead of the generic
+ * defaults below, so port bitmaps, per-port tables and the loops over
+ * them are sized for the board at compile time. Without a profile the
+ * build runs on any board, with room for the largest.
+ */
+#ifdef CONFIG_BOARD_PROFILE
+#include CONFIG_BOARD_PROFILE
+#endif
 
 /*===========================================================================*/
 /* SYSTEM CONFIGURATION                                                      */
 /*===========================================================================*/
 
+/**
+ * @brief Board type the BSP is initialized for (bsp_board_type_t)
+ */
+#ifndef CONFIG_BOARD_TYPE
+#define CONFIG_BOARD_TYPE                   BSP_BOARD_TYPE_MEDIUM
+#endif
+
 /**
  * @brief Maximum number of physical ports supported by the simulator
  *
@@ -33,6 +52,11 @@
 #define CONFIG_MAX_PORTS                    256
 #endif
 
+/**
+ * @brief Number of 64-bit words in a bitmap of every port ID
+ */
+#define CONFIG_PORT_BITMAP_WORDS            ((CONFIG_MAX_PORTS + 63) / 64)
+
 /**
  * @brief Default number of ports to initialize
  *
@@ -43,6 +67,16 @@
 #define CONFIG_DEFAULT_PORT_COUNT           128
 #endif
 
+/**
+ * @brief Maximum number of switch instances in one process
+ *
+ * Instance 0 is the process's own switch; the others are available to
+ * the topology engine (see switch_context.h and topology.h).
+ */
+#ifndef CONFIG_MAX_SWITCH_INSTANCES
+#define CONFIG_MAX_SWITCH_INSTANCES         128
+#endif
+
 /**
  * @brief Maximum number of VLANs supported
  *
@@ -60,6 +94,47 @@
 #define CONFIG_DEFAULT_VLAN_ID              1
 #endif
 
+/**
+ * @brief Maximum number of link aggregation groups of a switch
+ *
+ * LAGs are logical ports: LAG n has port ID CONFIG_LAG_PORT_BASE + n, at
+ * the top of the port ID space, and physical ports stay below it.
+ */
+#ifndef CONFIG_MAX_LAGS
+#define CONFIG_MAX_LAGS                     32
+#endif
+
+/**
+ * @brief Port ID of the first LAG
+ */
+#ifndef CONFIG_LAG_PORT_BASE
+#define CONFIG_LAG_PORT_BASE                (CONFIG_MAX_PORTS - CONFIG_MAX_LAGS)
+#endif
+
+/**
+ * @brief Maximum number of member ports of a LAG
+ */
+#ifndef CONFIG_LAG_MAX_MEMBERS
+#define CONFIG_LAG_MAX_MEMBERS              8
+#endif
+
+/**
+ * @brief Maximum number of VXLAN tunnels (remote VTEPs) of a switch
+ *
+ * Tunnels are logical ports too: tunnel n has port ID
+ * CONFIG_VXLAN_PORT_BASE + n, just below the LAGs.
+ */
+#ifndef CONFIG_VXLAN_MAX_TUNNELS
+#define CONFIG_VXLAN_MAX_TUNNELS            32
+#endif
+
+/**
+ * @brief Port ID of the first VXLAN tunnel
+ */
+#ifndef CONFIG_VXLAN_PORT_BASE
+#define CONFIG_VXLAN_PORT_BASE              (CONFIG_LAG_PORT_BASE - CONFIG_VXLAN_MAX_TUNNELS)
+#endif
+
 
 /*===========================================================================*/
 /* MEMORY AND PERFORMANCE CONFIGURATION                                      */
@@ -75,6 +150,18 @@
 #define CONFIG_MAX_MAC_TABLE_ENTRIES        65536
 #endif
 
+/**
+ * @brief Entries a MAC table may grow to while running
+ *
+ * A table that fills up past three quarters of its entry limit doubles
+ * its buckets a few at a time, from learning and from the aging tick, and
+ * raises the limit as the room appears. Set to 0 to keep every table at
+ * the size it was created with.
+ */
+#ifndef CONFIG_MAC_TABLE_GROW_MAX_ENTRIES
+#define CONFIG_MAC_TABLE_GROW_MAX_ENTRIES   (CONFIG_MAX_MAC_TABLE_ENTRIES * 4)
+#endif
+
 /**
  * @brief Default MAC address aging time in seconds
  *
@@ -85,6 +172,78 @@
 #define CONFIG_DEFAULT_MAC_AGING_TIME       300
 #endif
 
+/**
+ * @brief Maximum number of multicast groups per switch (IGMP/MLD snooping)
+ *
+ * Each (VLAN, group) entry and each VLAN with router ports takes one.
+ */
+#ifndef CONFIG_MCAST_SNOOP_MAX_GROUPS
+#define CONFIG_MCAST_SNOOP_MAX_GROUPS       4096
+#endif
+
+/**
+ * @brief Maximum number of port mirroring sessions (at most 32)
+ *
+ * Every session has one destination port; any number of ports and VLANs
+ * may feed it.
+ */
+#ifndef CONFIG_MIRROR_MAX_SESSIONS
+#define CONFIG_MIRROR_MAX_SESSIONS          8
+#endif
+
+/**
+ * @brief Number of policers (srTCM and trTCM meters), IDs 1 to this value
+ *
+ * Ports, VLANs and ACL rules name policers by ID; every policer's buckets
+ * take one cache line and its counters one shard slot per thread.
+ */
+#ifndef CONFIG_MAX_POLICERS
+#define CONFIG_MAX_POLICERS                 1024
+#endif
+
+/**
+ * @brief MPLS labels the LFIB can hold (labels 0 to this minus one)
+ *
+ * The LFIB is direct-indexed: one pointer per label, allocated zeroed so
+ * that only the pages of labels in use are ever backed by memory.
+ */
+#ifndef CONFIG_MPLS_LABEL_SPACE
+#define CONFIG_MPLS_LABEL_SPACE             (1 << 20)
+#endif
+
+/**
+ * @brief Learn events each forwarding thread can queue (must be power of 2)
+ *
+ * New and moved source MACs are queued for the learner thread instead of
+ * being written to the MAC table inline.
+ */
+#ifndef CONFIG_MAC_LEARN_QUEUE_SIZE
+#define CONFIG_MAC_LEARN_QUEUE_SIZE         4096
+#endif
+
+/**
+ * @brief Learn events applied by the learner per queue pass
+ */
+#ifndef CONFIG_MAC_LEARN_BATCH
+#define CONFIG_MAC_LEARN_BATCH              256
+#endif
+
+/**
+ * @brief Recent port moves after which a MAC is frozen on its port
+ *
+ * The per-entry move count halves every second without a move.
+ */
+#ifndef CONFIG_MAC_MOVE_THRESHOLD
+#define CONFIG_MAC_MOVE_THRESHOLD           8
+#endif
+
+/**
+ * @brief Seconds a flapping MAC stays frozen on its port
+ */
+#ifndef CONFIG_MAC_MOVE_FREEZE_TIME
+#define CONFIG_MAC_MOVE_FREEZE_TIME         30
+#endif
+
 /**
  * @brief Maximum number of routing table entries
  *
@@ -94,6 +253,69 @@
 #define CONFIG_MAX_ROUTING_ENTRIES          16384
 #endif
 
+/**
+ * @brief Fold FIB trie nodes whose addresses all use one next-hop group
+ *
+ * Shrinks the FIB and shortens lookups for address blocks split into many
+ * prefixes with the same next hops. Lookups then return a route with the
+ * same next hops rather than always the longest matching one; the RIB
+ * keeps every route.
+ */
+#ifndef CONFIG_FIB_COMPRESS
+#define CONFIG_FIB_COMPRESS                 0
+#endif
+
+/**
+ * @brief Multicast FIB capacity: (S,G) and (*,G) routes per switch, and
+ * outgoing interfaces per route
+ */
+#ifndef CONFIG_MFIB_MAX_ROUTES
+#define CONFIG_MFIB_MAX_ROUTES              8192
+#endif
+
+#ifndef CONFIG_MFIB_MAX_OIFS
+#define CONFIG_MFIB_MAX_OIFS                128
+#endif
+
+/**
+ * @brief Hardware route programming queue
+ *
+ * Prefixes waiting to be written to hardware (a power of two), prefixes
+ * programmed per batch, and how long the programming thread waits for a
+ * batch to fill before it takes a partial one.
+ */
+#ifndef CONFIG_ROUTE_HW_QUEUE_SIZE
+#define CONFIG_ROUTE_HW_QUEUE_SIZE          16384
+#endif
+
+#ifndef CONFIG_ROUTE_HW_BATCH
+#define CONFIG_ROUTE_HW_BATCH               256
+#endif
+
+#ifndef CONFIG_ROUTE_HW_INTERVAL_MS
+#define CONFIG_ROUTE_HW_INTERVAL_MS         2
+#endif
+
+/**
+ * @brief Maximum number of BFD sessions
+ *
+ * Preallocated at init, each with its own control packet template. The
+ * slot is the lower half of the local discriminator, hence the limit.
+ */
+#ifndef CONFIG_BFD_MAX_SESSIONS
+#define CONFIG_BFD_MAX_SESSIONS             4096
+#endif
+
+/**
+ * @brief Connections each forwarding worker can track
+ *
+ * A worker allocates its table on its first tracked packet, about 100
+ * bytes per connection, and drops new connections once it is full.
+ */
+#ifndef CONFIG_CONNTRACK_FLOWS_PER_WORKER
+#define CONFIG_CONNTRACK_FLOWS_PER_WORKER   262144
+#endif
+
 /**
  * @brief Maximum number of ARP table entries
  *
@@ -103,6 +325,28 @@
 #define CONFIG_MAX_ARP_ENTRIES              8192
 #endif
 
+/**
+ * @brief Entries the ARP and ND caches may grow to while running
+ *
+ * A full cache doubles its entry limit instead of recycling its oldest
+ * neighbor, and its hash chains are rehashed into twice as many buckets a
+ * few at a time as it fills. Set to 0 to keep CONFIG_MAX_ARP_ENTRIES.
+ */
+#ifndef CONFIG_ARP_GROW_MAX_ENTRIES
+#define CONFIG_ARP_GROW_MAX_ENTRIES         (CONFIG_MAX_ARP_ENTRIES * 4)
+#endif
+
+/**
+ * @brief Seed of the key the L2 and L3 tables hash with
+ *
+ * 0 draws a random key at startup, so nobody can craft addresses that
+ * collide. Any other value derives the key from it, for runs that must
+ * place every key in the same bucket each time.
+ */
+#ifndef CONFIG_KEYED_HASH_SEED
+#define CONFIG_KEYED_HASH_SEED              0
+#endif
+
 /**
  * @brief Default ARP entry aging time in seconds
  */
@@ -141,6 +385,16 @@
 #define CONFIG_MAX_PACKET_SIZE              (CONFIG_MAX_MTU + 256)
 #endif
 
+/**
+ * @brief Headroom reserved in front of packet data in bytes
+ *
+ * Lets encapsulation (VLAN/QinQ/MPLS tags) be pushed by moving the data
+ * pointer instead of shifting the payload.
+ */
+#ifndef CONFIG_PACKET_HEADROOM
+#define CONFIG_PACKET_HEADROOM              128
+#endif
+
 /**
  * @brief Number of packet buffers to pre-allocate
  *
@@ -150,6 +404,23 @@
 #define CONFIG_PACKET_BUFFER_POOL_SIZE      4096
 #endif
 
+/**
+ * @brief Data capacity of a packet segment in bytes
+ *
+ * Chained packets (jumbo frames, IP fragments and reassembled datagrams)
+ * are built from segments of this size.
+ */
+#ifndef CONFIG_PACKET_SEGMENT_SIZE
+#define CONFIG_PACKET_SEGMENT_SIZE          2048
+#endif
+
+/**
+ * @brief Number of packet segments to pre-allocate
+ */
+#ifndef CONFIG_PACKET_SEGMENT_POOL_SIZE
+#define CONFIG_PACKET_SEGMENT_POOL_SIZE     8192
+#endif
+
 /**
  * @brief Maximum number of fragments per IP packet
  *
@@ -181,6 +452,128 @@
 #define CONFIG_WORKER_THREADS               0       /* Auto-detect */
 #endif
 
+/**
+ * @brief Upper bound on forwarding worker threads
+ */
+#ifndef CONFIG_MAX_WORKER_THREADS
+#define CONFIG_MAX_WORKER_THREADS           64
+#endif
+
+/**
+ * @brief CPUs forwarding workers are pinned to, in order, e.g. "0-7,16-23"
+ *
+ * NULL pins worker i to CPU i.
+ */
+#ifndef CONFIG_WORKER_CPU_LIST
+#define CONFIG_WORKER_CPU_LIST              NULL
+#endif
+
+/**
+ * @brief Empty poll rounds a forwarding worker spins through before backing off
+ */
+#ifndef CONFIG_FWD_IDLE_SPIN_POLLS
+#define CONFIG_FWD_IDLE_SPIN_POLLS          256
+#endif
+
+/**
+ * @brief Further empty poll rounds with pause backoff before a worker blocks
+ */
+#ifndef CONFIG_FWD_IDLE_PAUSE_POLLS
+#define CONFIG_FWD_IDLE_PAUSE_POLLS         2048
+#endif
+
+/**
+ * @brief Let idle forwarding workers block until packets arrive
+ *
+ * 0 keeps them polling with pause backoff, for the lowest latency.
+ */
+#ifndef CONFIG_FWD_IDLE_BLOCK
+#define CONFIG_FWD_IDLE_BLOCK               1
+#endif
+
+/**
+ * @brief Longest a blocked forwarding worker sleeps between looks at its rings (milliseconds)
+ */
+#ifndef CONFIG_FWD_IDLE_BLOCK_MS
+#define CONFIG_FWD_IDLE_BLOCK_MS            100
+#endif
+
+/**
+ * @brief Threads that run independent startup steps at once
+ *
+ * 1 runs every step on the calling thread, in order; 0 uses one per CPU.
+ */
+#ifndef CONFIG_INIT_THREADS
+#define CONFIG_INIT_THREADS                 0
+#endif
+
+/**
+ * @brief Largest number of NUMA nodes memory is placed on
+ */
+#ifndef CONFIG_NUMA_MAX_NODES
+#define CONFIG_NUMA_MAX_NODES               8
+#endif
+
+/**
+ * @brief Keep a copy of read-mostly lookup tables on every NUMA node
+ *
+ * Costs one copy per node on every table update; lets workers of every
+ * socket look up from local memory.
+ */
+#ifndef CONFIG_NUMA_REPLICATE_TABLES
+#define CONFIG_NUMA_REPLICATE_TABLES        0
+#endif
+
+/**
+ * @brief Back memory arenas with explicit huge pages when the kernel has them
+ *
+ * Arenas fall back to transparent huge pages, then to normal pages, when
+ * no huge pages are reserved (vm.nr_hugepages).
+ */
+#ifndef CONFIG_MEM_ARENA_HUGETLB
+#define CONFIG_MEM_ARENA_HUGETLB            1
+#endif
+
+/**
+ * @brief Bytes an arena maps at a time, a multiple of 2MB
+ *
+ * Allocations of more than half a block get a mapping of their own.
+ */
+#ifndef CONFIG_MEM_ARENA_BLOCK_SIZE
+#define CONFIG_MEM_ARENA_BLOCK_SIZE         (2u * 1024 * 1024)
+#endif
+
+/**
+ * @brief Default number of ports of each topology switch
+ */
+#ifndef CONFIG_TOPOLOGY_PORTS
+#define CONFIG_TOPOLOGY_PORTS               8
+#endif
+
+/**
+ * @brief Receive ring slots per port of a topology switch, a power of two
+ */
+#ifndef CONFIG_TOPOLOGY_RING_SIZE
+#define CONFIG_TOPOLOGY_RING_SIZE           512
+#endif
+
+/**
+ * @brief MAC table entries of each topology switch
+ */
+#ifndef CONFIG_TOPOLOGY_MAC_TABLE_SIZE
+#define CONFIG_TOPOLOGY_MAC_TABLE_SIZE      4096
+#endif
+
+/**
+ * @brief Default topology link latency in nanoseconds
+ *
+ * Nonzero runs the fabric as a parallel discrete-event simulation in time
+ * windows of the smallest link latency; 0 lets the workers run free.
+ */
+#ifndef CONFIG_TOPOLOGY_LINK_LATENCY_NS
+#define CONFIG_TOPOLOGY_LINK_LATENCY_NS     0
+#endif
+
 /**
  * @brief Maximum queue depth for inter-thread communication
  */
@@ -195,6 +588,47 @@
 #define CONFIG_RING_BUFFER_SIZE             2048
 #endif
 
+/**
+ * @brief Longest spinlock backoff, in pause instructions
+ *
+ * A waiter pauses 1, 2, 4, ... times between looks at a held lock, up to
+ * this many.
+ */
+#ifndef CONFIG_SPINLOCK_BACKOFF_MAX
+#define CONFIG_SPINLOCK_BACKOFF_MAX         1024
+#endif
+
+/**
+ * @brief Count acquisitions, contended acquisitions and spins of every spinlock
+ *
+ * Adds three counters to each lock, written by the holder; see
+ * spinlock_get_stats(). Locks named with spinlock_set_class() also record
+ * wait and hold time histograms per class (common/lock_stat.h), shown by
+ * the "locks" CLI command. Costs two clock reads per classed acquisition.
+ */
+#ifndef CONFIG_SPINLOCK_STATS
+#define CONFIG_SPINLOCK_STATS               0
+#endif
+
+/**
+ * @brief Event loop timer wheel tick in microseconds
+ *
+ * Timer deadlines are rounded up to this granularity.
+ */
+#ifndef CONFIG_EVENT_LOOP_TICK_US
+#define CONFIG_EVENT_LOOP_TICK_US           100
+#endif
+
+/**
+ * @brief Start on the virtual simulator clock
+ *
+ * 1 runs timers in discrete-event mode: the clock jumps to the next
+ * deadline whenever the event loop is idle (see sim_clock.h).
+ */
+#ifndef CONFIG_SIM_CLOCK_VIRTUAL
+#define CONFIG_SIM_CLOCK_VIRTUAL            0
+#endif
+
 
 /*===========================================================================*/
 /* LOGGING AND DEBUGGING CONFIGURATION                                       */
@@ -209,6 +643,21 @@
 #define CONFIG_DEFAULT_LOG_LEVEL            2       /* INFO */
 #endif
 
+/**
+ * @brief Most detailed log level compiled in, on the scale above
+ *
+ * LOG_* calls of more detailed levels compile to nothing, arguments
+ * included. Release builds (NDEBUG) keep CONFIG_DEFAULT_LOG_LEVEL, so
+ * debug and trace messages cost them nothing; other builds keep all.
+ */
+#ifndef CONFIG_LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define CONFIG_LOG_COMPILE_LEVEL            CONFIG_DEFAULT_LOG_LEVEL
+#else
+#define CONFIG_LOG_COMPILE_LEVEL            4       /* TRACE */
+#endif
+#endif
+
 /**
  * @brief Maximum length of log messages in characters
  */
@@ -218,11 +667,195 @@
 
 /**
  * @brief Size of circular log buffer (number of messages)
+ *
+ * Sizes the per-thread rings of asynchronous logging, for messages of
+ * about 64 bytes with their arguments.
  */
 #ifndef CONFIG_LOG_BUFFER_SIZE
 #define CONFIG_LOG_BUFFER_SIZE              10000
 #endif
 
+/**
+ * @brief Messages a rate-limited LOG_*_RATELIMITED call site logs back to back
+ */
+#ifndef CONFIG_LOG_RATELIMIT_BURST
+#define CONFIG_LOG_RATELIMIT_BURST          10
+#endif
+
+/**
+ * @brief Milliseconds a rate-limited call site takes to earn one more message
+ */
+#ifndef CONFIG_LOG_RATELIMIT_INTERVAL_MS
+#define CONFIG_LOG_RATELIMIT_INTERVAL_MS    1000
+#endif
+
+/**
+ * @brief Start logging in asynchronous mode
+ *
+ * When true, log_init() turns on the background logging thread, see
+ * log_set_async().
+ */
+#ifndef CONFIG_ENABLE_ASYNC_LOGGING
+#define CONFIG_ENABLE_ASYNC_LOGGING         false
+#endif
+
+/**
+ * @brief Compile in binary tracepoints
+ *
+ * When 1, modules record high-rate events such as MAC learning and route
+ * changes into per-thread trace rings, see common/trace.h. Tracepoints
+ * cost a load and a branch while their event is off. When 0 they are not
+ * compiled in at all.
+ */
+#ifndef CONFIG_ENABLE_TRACING
+#define CONFIG_ENABLE_TRACING               1
+#endif
+
+/**
+ * @brief Trace records kept per thread, a power of two; the oldest are overwritten
+ */
+#ifndef CONFIG_TRACE_RING_SIZE
+#define CONFIG_TRACE_RING_SIZE              8192
+#endif
+
+/**
+ * @brief Events the SAI notification ring holds, a power of two
+ *
+ * Events reported while the ring is full are dropped and counted.
+ */
+#ifndef CONFIG_SAI_NOTIFY_RING_SIZE
+#define CONFIG_SAI_NOTIFY_RING_SIZE         16384
+#endif
+
+/**
+ * @brief Most events the SAI notification thread coalesces and delivers at once
+ */
+#ifndef CONFIG_SAI_NOTIFY_BATCH
+#define CONFIG_SAI_NOTIFY_BATCH             512
+#endif
+
+/**
+ * @brief Milliseconds the SAI notification thread sleeps once the ring is empty
+ */
+#ifndef CONFIG_SAI_NOTIFY_INTERVAL_MS
+#define CONFIG_SAI_NOTIFY_INTERVAL_MS       10
+#endif
+
+/**
+ * @brief Events the subscriber event feed holds, a power of two
+ *
+ * Events posted while the ring is full are dropped and counted, see
+ * common/event_feed.h.
+ */
+#ifndef CONFIG_EVENT_FEED_RING_SIZE
+#define CONFIG_EVENT_FEED_RING_SIZE         8192
+#endif
+
+/**
+ * @brief Events the internal event bus holds until the event loop takes them, a power of two
+ *
+ * Events posted while the ring is full are dropped and counted, see
+ * common/event_bus.h.
+ */
+#ifndef CONFIG_EVENT_BUS_RING_SIZE
+#define CONFIG_EVENT_BUS_RING_SIZE          8192
+#endif
+
+/**
+ * @brief Most events the event bus hands to a subscriber at once, a power of two
+ *
+ * Coalescing subscribers see only the latest event per object within
+ * one batch.
+ */
+#ifndef CONFIG_EVENT_BUS_BATCH
+#define CONFIG_EVENT_BUS_BATCH              256
+#endif
+
+/**
+ * @brief Modules that can subscribe to the event bus at the same time
+ */
+#ifndef CONFIG_EVENT_BUS_MAX_SUBSCRIBERS
+#define CONFIG_EVENT_BUS_MAX_SUBSCRIBERS    16
+#endif
+
+/**
+ * @brief Core the control plane's event loop thread is pinned to, -1 to leave it
+ *
+ * Protocol timers and control tasks all run on that thread, see
+ * common/event_task.h.
+ */
+#ifndef CONFIG_CONTROL_PLANE_CPU
+#define CONFIG_CONTROL_PLANE_CPU            -1
+#endif
+
+/**
+ * @brief Control tasks that can be spawned at the same time, a power of two
+ */
+#ifndef CONFIG_EVENT_TASK_MAX
+#define CONFIG_EVENT_TASK_MAX               1024
+#endif
+
+/**
+ * @brief Flow samples the sFlow agent queues for export, a power of two
+ *
+ * Samples taken while the ring is full are dropped and reported as the
+ * drops of their port, see management/sflow.h.
+ */
+#ifndef CONFIG_SFLOW_RING_SIZE
+#define CONFIG_SFLOW_RING_SIZE              4096
+#endif
+
+/**
+ * @brief Bytes of a sampled frame the sFlow agent captures, a multiple of 4
+ */
+#ifndef CONFIG_SFLOW_HEADER_BYTES
+#define CONFIG_SFLOW_HEADER_BYTES           128
+#endif
+
+/**
+ * @brief Connections the management server keeps open at once
+ *
+ * Connections accepted beyond this are closed at once and counted, see
+ * management/mgmt_server.h.
+ */
+#ifndef CONFIG_MGMT_SERVER_MAX_CONNECTIONS
+#define CONFIG_MGMT_SERVER_MAX_CONNECTIONS  256
+#endif
+
+/**
+ * @brief Largest request body the management server accepts, in bytes
+ */
+#ifndef CONFIG_MGMT_SERVER_MAX_BODY
+#define CONFIG_MGMT_SERVER_MAX_BODY         (4u << 20)
+#endif
+
+/**
+ * @brief Requests the management server handles on a connection per wakeup
+ *
+ * Pipelined requests past this wait until every other ready connection
+ * had its turn.
+ */
+#ifndef CONFIG_MGMT_SERVER_REQUESTS_PER_EVENT
+#define CONFIG_MGMT_SERVER_REQUESTS_PER_EVENT 16
+#endif
+
+/**
+ * @brief Records of the shared CPU trap ring, a power of two
+ *
+ * Packets trapped while the external consumer is this far behind are
+ * dropped and counted in the ring header, see hal/cpu_trap.h.
+ */
+#ifndef CONFIG_CPU_TRAP_RING_SIZE
+#define CONFIG_CPU_TRAP_RING_SIZE           4096
+#endif
+
+/**
+ * @brief Bytes of a trapped packet kept in its ring record
+ */
+#ifndef CONFIG_CPU_TRAP_SNAPLEN
+#define CONFIG_CPU_TRAP_SNAPLEN             2048
+#endif
+
 /**
  * @brief Enable/disable runtime statistics collection
  * 
@@ -240,6 +873,68 @@
 #define CONFIG_STATS_COLLECTION_INTERVAL_MS 1000
 #endif
 
+/**
+ * @brief Enable per-stage pipeline latency histograms
+ *
+ * When 1, every packet processor call and the RX-to-TX ring residency of
+ * every packet are timed in cycles, see hal/packet_profile.h. When 0 the
+ * instrumentation is not compiled in at all.
+ */
+#ifndef CONFIG_ENABLE_PIPELINE_PROFILING
+#define CONFIG_ENABLE_PIPELINE_PROFILING    0
+#endif
+
+/**
+ * @brief Compile in in-band network telemetry, see hal/int_telemetry.h
+ *
+ * When 1, packets carry the INT fields in their metadata and the egress
+ * path can stamp per-hop records into flows selected by ACL rules; the
+ * mode still has to be switched on at run time. When 0 none of it is
+ * compiled in.
+ */
+#ifndef CONFIG_ENABLE_INT
+#define CONFIG_ENABLE_INT                   1
+#endif
+
+/**
+ * @brief Hop records an INT shim header holds; further hops only count themselves
+ */
+#ifndef CONFIG_INT_MAX_HOPS
+#define CONFIG_INT_MAX_HOPS                 8
+#endif
+
+/**
+ * @brief Hops (switch ID and egress port) an INT sink keeps statistics for
+ */
+#ifndef CONFIG_INT_SINK_SLOTS
+#define CONFIG_INT_SINK_SLOTS               256
+#endif
+
+/**
+ * @brief Cache or TLB misses per thousand instructions from which a code
+ *        region counts as memory-bound, see common/perf_counters.h
+ */
+#ifndef CONFIG_PERF_MEMORY_BOUND_MPKI
+#define CONFIG_PERF_MEMORY_BOUND_MPKI       5
+#endif
+
+/**
+ * @brief Capture one in this many drops of each thread, 0 for none
+ *
+ * Drops are always counted by reason, see hal/packet_drop.h; the rate
+ * can be changed at run time.
+ */
+#ifndef CONFIG_PACKET_DROP_SAMPLE_RATE
+#define CONFIG_PACKET_DROP_SAMPLE_RATE      1024
+#endif
+
+/**
+ * @brief Captured drops kept, the oldest are overwritten
+ */
+#ifndef CONFIG_PACKET_DROP_CAPTURE_SIZE
+#define CONFIG_PACKET_DROP_CAPTURE_SIZE     256
+#endif
+
 
 /*===========================================================================*/
 /* SIMULATION-SPECIFIC CONFIGURATION                                         */
@@ -272,6 +967,24 @@
 #define CONFIG_SIM_MEMORY_DELAY_NS          100
 #endif
 
+/**
+ * @brief Calendar of the ASIC timing model, see hal/sim_timing.h
+ *
+ * Bucket width in nanoseconds, number of buckets (a power of two; width
+ * times count is the scheduling horizon) and packets the calendar holds.
+ */
+#ifndef CONFIG_SIM_TIMING_BUCKET_NS
+#define CONFIG_SIM_TIMING_BUCKET_NS         1000
+#endif
+
+#ifndef CONFIG_SIM_TIMING_BUCKETS
+#define CONFIG_SIM_TIMING_BUCKETS           8192
+#endif
+
+#ifndef CONFIG_SIM_TIMING_MAX_PACKETS
+#define CONFIG_SIM_TIMING_MAX_PACKETS       16384
+#endif
+
 /**
  * @brief Enable random packet drop simulation
  * 
@@ -345,10 +1058,121 @@
 #error "CONFIG_MAX_PORTS cannot exceed 65535"
 #endif
 
+#if CONFIG_MAC_TABLE_GROW_MAX_ENTRIES != 0 && \
+    (CONFIG_MAC_TABLE_GROW_MAX_ENTRIES < CONFIG_MAX_MAC_TABLE_ENTRIES || \
+     CONFIG_MAC_TABLE_GROW_MAX_ENTRIES > 16777216)
+#error "CONFIG_MAC_TABLE_GROW_MAX_ENTRIES must be 0 or between CONFIG_MAX_MAC_TABLE_ENTRIES and 16777216"
+#endif
+
+#if CONFIG_ARP_GROW_MAX_ENTRIES != 0 && \
+    (CONFIG_ARP_GROW_MAX_ENTRIES < CONFIG_MAX_ARP_ENTRIES || CONFIG_ARP_GROW_MAX_ENTRIES > 65535)
+#error "CONFIG_ARP_GROW_MAX_ENTRIES must be 0 or between CONFIG_MAX_ARP_ENTRIES and 65535"
+#endif
+
+#if CONFIG_MIRROR_MAX_SESSIONS < 1 || CONFIG_MIRROR_MAX_SESSIONS > 32
+#error "CONFIG_MIRROR_MAX_SESSIONS must be between 1 and 32"
+#endif
+
 #if CONFIG_DEFAULT_PORT_COUNT > CONFIG_MAX_PORTS
 #error "CONFIG_DEFAULT_PORT_COUNT cannot exceed CONFIG_MAX_PORTS"
 #endif
 
+#if CONFIG_LAG_PORT_BASE + CONFIG_MAX_LAGS > CONFIG_MAX_PORTS
+#error "LAG port IDs cannot exceed CONFIG_MAX_PORTS"
+#endif
+
+#if CONFIG_DEFAULT_PORT_COUNT > CONFIG_LAG_PORT_BASE
+#error "CONFIG_DEFAULT_PORT_COUNT cannot reach into the LAG port IDs"
+#endif
+
+#if CONFIG_LAG_MAX_MEMBERS < 1 || CONFIG_LAG_MAX_MEMBERS > 32
+#error "CONFIG_LAG_MAX_MEMBERS must be between 1 and 32"
+#endif
+
+#if CONFIG_VXLAN_MAX_TUNNELS < 1 || CONFIG_VXLAN_MAX_TUNNELS > 64
+#error "CONFIG_VXLAN_MAX_TUNNELS must be between 1 and 64"
+#endif
+
+#if CONFIG_VXLAN_PORT_BASE + CONFIG_VXLAN_MAX_TUNNELS > CONFIG_LAG_PORT_BASE
+#error "VXLAN tunnel port IDs cannot reach into the LAG port IDs"
+#endif
+
+#if CONFIG_DEFAULT_PORT_COUNT > CONFIG_VXLAN_PORT_BASE
+#error "CONFIG_DEFAULT_PORT_COUNT cannot reach into the VXLAN tunnel port IDs"
+#endif
+
+#if CONFIG_MAX_POLICERS < 1 || CONFIG_MAX_POLICERS > 65535
+#error "CONFIG_MAX_POLICERS must be between 1 and 65535"
+#endif
+
+#if CONFIG_INT_MAX_HOPS < 1 || CONFIG_INT_MAX_HOPS > 64
+#error "CONFIG_INT_MAX_HOPS must be between 1 and 64"
+#endif
+
+#if CONFIG_INT_SINK_SLOTS < 1 || CONFIG_INT_SINK_SLOTS > 65536
+#error "CONFIG_INT_SINK_SLOTS must be between 1 and 65536"
+#endif
+
+#if CONFIG_MPLS_LABEL_SPACE < 16 || CONFIG_MPLS_LABEL_SPACE > (1 << 20)
+#error "CONFIG_MPLS_LABEL_SPACE must be between 16 and 2^20"
+#endif
+
+#if CONFIG_SPINLOCK_BACKOFF_MAX < 1 || CONFIG_SPINLOCK_BACKOFF_MAX > 65536
+#error "CONFIG_SPINLOCK_BACKOFF_MAX must be between 1 and 65536"
+#endif
+
+#if (CONFIG_CPU_TRAP_RING_SIZE & (CONFIG_CPU_TRAP_RING_SIZE - 1)) != 0
+#error "CONFIG_CPU_TRAP_RING_SIZE must be a power of 2"
+#endif
+
+#if CONFIG_CPU_TRAP_SNAPLEN < 64 || CONFIG_CPU_TRAP_SNAPLEN > 65535
+#error "CONFIG_CPU_TRAP_SNAPLEN must be between 64 and 65535"
+#endif
+
+#if CONFIG_MAX_SWITCH_INSTANCES < 1
+#error "CONFIG_MAX_SWITCH_INSTANCES must be at least 1"
+#endif
+
+#if CONFIG_BFD_MAX_SESSIONS < 1 || CONFIG_BFD_MAX_SESSIONS > 65535
+#error "CONFIG_BFD_MAX_SESSIONS must be between 1 and 65535"
+#endif
+
+#if CONFIG_CONNTRACK_FLOWS_PER_WORKER < 64 || CONFIG_CONNTRACK_FLOWS_PER_WORKER > (1 << 24)
+#error "CONFIG_CONNTRACK_FLOWS_PER_WORKER must be between 64 and 16777216"
+#endif
+
+#if CONFIG_FWD_IDLE_BLOCK_MS < 1 || CONFIG_FWD_IDLE_BLOCK_MS > 60000
+#error "CONFIG_FWD_IDLE_BLOCK_MS must be between 1 and 60000"
+#endif
+
+#if CONFIG_MGMT_SERVER_MAX_CONNECTIONS < 1 || CONFIG_MGMT_SERVER_MAX_CONNECTIONS > 65536
+#error "CONFIG_MGMT_SERVER_MAX_CONNECTIONS must be between 1 and 65536"
+#endif
+
+#if CONFIG_MGMT_SERVER_MAX_BODY < 4096 || CONFIG_MGMT_SERVER_REQUESTS_PER_EVENT < 1
+#error "CONFIG_MGMT_SERVER_MAX_BODY must be at least 4096 and CONFIG_MGMT_SERVER_REQUESTS_PER_EVENT at least 1"
+#endif
+
+#if CONFIG_EVENT_BUS_BATCH < 1 || CONFIG_EVENT_BUS_BATCH > 16384 || CONFIG_EVENT_BUS_BATCH > CONFIG_EVENT_BUS_RING_SIZE
+#error "CONFIG_EVENT_BUS_BATCH must be between 1 and 16384 and fit CONFIG_EVENT_BUS_RING_SIZE"
+#endif
+
+#if CONFIG_EVENT_BUS_MAX_SUBSCRIBERS < 1 || CONFIG_EVENT_BUS_MAX_SUBSCRIBERS > 64
+#error "CONFIG_EVENT_BUS_MAX_SUBSCRIBERS must be between 1 and 64"
+#endif
+
+#if CONFIG_EVENT_TASK_MAX < 2 || (CONFIG_EVENT_TASK_MAX & (CONFIG_EVENT_TASK_MAX - 1)) != 0
+#error "CONFIG_EVENT_TASK_MAX must be a power of two, at least 2"
+#endif
+
+#if CONFIG_NUMA_MAX_NODES < 1 || CONFIG_NUMA_MAX_NODES > 64
+#error "CONFIG_NUMA_MAX_NODES must be between 1 and 64"
+#endif
+
+#if CONFIG_MEM_ARENA_BLOCK_SIZE == 0 || CONFIG_MEM_ARENA_BLOCK_SIZE % (2u * 1024 * 1024) != 0
+#error "CONFIG_MEM_ARENA_BLOCK_SIZE must be a nonzero multiple of 2MB"
+#endif
+
 #if CONFIG_MAX_VLANS > 4094
 #error "CONFIG_MAX_VLANS cannot exceed 4094 (IEEE 802.1Q limit)"
 #endif
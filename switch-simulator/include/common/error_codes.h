@@ -163,6 +163,8 @@ typedef enum
 #define ERROR_INVALID_PORT                  -223    /**< Invalid port */
 #define ERROR_MEMORY_ALLOCATION_FAILED      -224
 #define ERROR_PACKET_ALLOCATION_FAILED      -225
+#define ERROR_ICMP_RATE_LIMITED             -226    /**< ICMP error refused by the rate limit */
+#define ERROR_PUNT_POLICED                  -227    /**< Packet refused by the control-plane policer */
 
 /*===========================================================================*/
 /* 4. DRIVER AND BSP ERRORS (-300 to -399)                                   */
@@ -0,0 +1,155 @@
+/**
+ * @file event_bus.h
+ * @brief Internal publish/subscribe bus for control plane events
+ *
+ * The bus carries the events of the event feed (see event_feed.h) to
+ * any number of modules inside the simulator. Producers post exactly as
+ * they do for the feed: event_feed_enabled() is on while the feed or a
+ * bus subscriber wants the kind, and the post helpers put the event on
+ * the bus ring once, however many modules subscribed to it.
+ *
+ * Delivery is off the producer's path. The ring is drained on the event
+ * loop thread in batches of up to CONFIG_EVENT_BUS_BATCH events; each
+ * subscriber gets its own view of a batch, filtered by its kinds and,
+ * when it asked for it, coalesced so that only the latest event per
+ * object is handed over. Handlers therefore never run inside a
+ * producer's critical section and may take any lock.
+ *
+ * Posting never blocks and never allocates: events posted while the
+ * ring is full are dropped and counted.
+ */
+
+#ifndef SWITCH_SIM_EVENT_BUS_H
+#define SWITCH_SIM_EVENT_BUS_H
+
+#include <stddef.h>
+
+#include "types.h"
+#include "error_codes.h"
+#include "event_feed.h"
+
+/**
+ * @brief Subscriber flags
+ */
+#define EVENT_BUS_COALESCE      0x1     /**< Keep only the latest event per object in a batch */
+
+/**
+ * @brief Subscriber handler
+ *
+ * Runs on the event loop thread. The events are valid only for the
+ * duration of the call. A handler must not unsubscribe itself.
+ *
+ * @param events Events, oldest first
+ * @param count Number of events, at least 1
+ * @param user_data Argument given to event_bus_subscribe()
+ */
+typedef void (*event_bus_handler_t)(const event_feed_event_t *events, uint32_t count, void *user_data);
+
+/**
+ * @brief Bus counters
+ */
+typedef struct {
+    uint64_t published;         /**< Events put on the ring */
+    uint64_t dropped;           /**< Events lost to a full ring */
+    uint64_t batches;           /**< Batches taken off the ring */
+    uint32_t subscribers;       /**< Current subscribers */
+} event_bus_stats_t;
+
+/**
+ * @brief Counters of one subscriber
+ */
+typedef struct {
+    uint64_t delivered;         /**< Events handed to the handler */
+    uint64_t coalesced;         /**< Events replaced by a later one of the same object */
+    uint64_t calls;             /**< Handler invocations */
+} event_bus_subscriber_stats_t;
+
+/**
+ * @brief Create the ring and watch it from the event loop
+ *
+ * Call after event_loop_init().
+ *
+ * @return STATUS_SUCCESS, STATUS_ALREADY_INITIALIZED, STATUS_NO_MEMORY or
+ *         the error of event_loop_add_fd()
+ */
+status_t event_bus_init(void);
+
+/**
+ * @brief Deliver what is left, drop every subscription and free the ring
+ *
+ * Call before event_loop_shutdown().
+ *
+ * @return STATUS_SUCCESS or STATUS_NOT_INITIALIZED
+ */
+status_t event_bus_shutdown(void);
+
+/**
+ * @brief Subscribe a module to kinds of events
+ *
+ * @param name Name shown in the report, kept by reference
+ * @param kinds Mask of kinds, bit n for event_feed_kind_t n
+ * @param flags EVENT_BUS_* flags
+ * @param handler Handler
+ * @param user_data Argument passed to the handler
+ * @param[out] id Subscription, for event_bus_unsubscribe()
+ * @return STATUS_SUCCESS, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ *         or STATUS_RESOURCE_EXHAUSTED past CONFIG_EVENT_BUS_MAX_SUBSCRIBERS
+ */
+status_t event_bus_subscribe(const char *name, uint32_t kinds, uint32_t flags,
+                             event_bus_handler_t handler, void *user_data, uint32_t *id);
+
+/**
+ * @brief Drop a subscription
+ *
+ * Once this returns the handler is not running and will not be called
+ * again. Events already on the ring are not delivered to it.
+ *
+ * @param id Subscription
+ * @return STATUS_SUCCESS, STATUS_NOT_INITIALIZED or STATUS_NOT_FOUND
+ */
+status_t event_bus_unsubscribe(uint32_t id);
+
+/**
+ * @brief Put an event on the ring; called by event_feed_post()
+ *
+ * @param event Event with its timestamp filled in
+ */
+void event_bus_publish(const event_feed_event_t *event);
+
+/**
+ * @brief Deliver the events waiting on the ring
+ *
+ * The event loop calls this when the ring's eventfd fires. Only one
+ * thread may dispatch at a time.
+ *
+ * @return Events taken off the ring
+ */
+uint32_t event_bus_dispatch(void);
+
+/**
+ * @brief Read the bus counters
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS or STATUS_INVALID_PARAMETER
+ */
+status_t event_bus_get_stats(event_bus_stats_t *stats);
+
+/**
+ * @brief Read the counters of a subscriber
+ *
+ * @param id Subscription
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER or STATUS_NOT_FOUND
+ */
+status_t event_bus_get_subscriber_stats(uint32_t id, event_bus_subscriber_stats_t *stats);
+
+/**
+ * @brief Format the bus and subscriber counters as text
+ *
+ * @param output Buffer
+ * @param output_len Buffer size
+ * @return Characters written
+ */
+size_t event_bus_report(char *output, size_t output_len);
+
+#endif /* SWITCH_SIM_EVENT_BUS_H */
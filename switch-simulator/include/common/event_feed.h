@@ -0,0 +1,154 @@
+/**
+ * @file event_feed.h
+ * @brief Control plane event feed for external subscribers
+ *
+ * MAC learning and aging, port link changes, FIB changes and STP role
+ * changes are posted, when subscribed to, to a lock-free ring with one
+ * consumer, usually a test harness or the Python API. The ring comes with
+ * an eventfd that becomes readable when events are waiting, so the
+ * consumer can sleep in epoll or in an asyncio loop instead of polling.
+ *
+ * Posting never blocks and never allocates: events reported while the
+ * ring is full are dropped and counted. A post point of a kind nobody
+ * subscribed to costs one relaxed load and a predicted branch.
+ */
+
+#ifndef SWITCH_SIM_EVENT_FEED_H
+#define SWITCH_SIM_EVENT_FEED_H
+
+#include "types.h"
+#include "error_codes.h"
+
+/**
+ * @brief Kinds of events; subscriptions are masks of 1 << kind
+ */
+typedef enum {
+    EVENT_FEED_MAC_LEARN = 0,   /**< Dynamic entry learned or moved to port_id */
+    EVENT_FEED_MAC_AGE,         /**< Dynamic entry aged out of port_id */
+    EVENT_FEED_LINK,            /**< Link of port_id changed, new_value is the port_state_t */
+    EVENT_FEED_ROUTE_ADD,       /**< Prefix installed in the FIB */
+    EVENT_FEED_ROUTE_DELETE,    /**< Prefix withdrawn from the FIB */
+    EVENT_FEED_ROUTE_CHANGE,    /**< Next hops of an installed prefix changed */
+    EVENT_FEED_STP_ROLE,        /**< STP role of port_id changed, old_value to new_value */
+    EVENT_FEED_KIND_COUNT
+} event_feed_kind_t;
+
+/** Mask of every kind */
+#define EVENT_FEED_ALL_KINDS    ((1U << EVENT_FEED_KIND_COUNT) - 1)
+
+/**
+ * @brief One event; the layout is fixed for foreign function callers
+ *
+ * Fields a kind does not use are zero. Route events carry the VRF in
+ * vlan_id and the prefix in addr, an IPv4 prefix in its first 4 bytes.
+ */
+typedef struct {
+    uint64_t timestamp_us;      /**< Simulator clock, see sim_clock_now_us() */
+    uint16_t kind;              /**< event_feed_kind_t */
+    uint16_t port_id;
+    uint16_t vlan_id;           /**< VLAN, or VRF for route events */
+    uint8_t old_value;
+    uint8_t new_value;
+    uint8_t mac[MAC_ADDR_LEN];
+    uint8_t prefix_len;
+    uint8_t is_ipv6;
+    uint8_t addr[16];
+} event_feed_event_t;
+
+/**
+ * @brief Event feed counters
+ */
+typedef struct {
+    uint64_t posted;            /**< Events put on the ring */
+    uint64_t dropped;           /**< Events lost to a full ring */
+    uint64_t read;              /**< Events taken by the consumer */
+} event_feed_stats_t;
+
+/** Kinds subscribed to, one bit per event_feed_kind_t */
+extern uint32_t g_event_feed_kinds;
+
+/** Kinds some module subscribed to on the internal bus, see event_bus.h */
+extern uint32_t g_event_bus_kinds;
+
+/**
+ * @brief Check if a kind is subscribed to, on the feed or on the bus
+ */
+static inline bool event_feed_enabled(event_feed_kind_t kind) {
+    uint32_t kinds = __atomic_load_n(&g_event_feed_kinds, __ATOMIC_RELAXED) |
+                     __atomic_load_n(&g_event_bus_kinds, __ATOMIC_RELAXED);
+
+    return __builtin_expect((kinds >> kind) & 1, 0);
+}
+
+/**
+ * @brief Subscribe to kinds of events, replacing the previous subscription
+ *
+ * The ring and its eventfd are created on the first call and live until
+ * the process exits. Events already on the ring stay there.
+ *
+ * @param kinds Mask of kinds, bit n for event_feed_kind_t n; 0 to stop
+ * @param[out] fd Eventfd readable while events are waiting, may be NULL
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER or STATUS_NO_MEMORY
+ */
+status_t event_feed_subscribe(uint32_t kinds, int *fd);
+
+/**
+ * @brief Take waiting events off the ring
+ *
+ * Only one thread may read. Also clears the eventfd, so a consumer that
+ * waits for the descriptor should read until fewer than max events come
+ * back.
+ *
+ * @param[out] events Events, oldest first
+ * @param max Events the array holds
+ * @param[out] count Events taken
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER or STATUS_NOT_INITIALIZED
+ */
+status_t event_feed_read(event_feed_event_t *events, uint32_t max, uint32_t *count);
+
+/**
+ * @brief Read the event feed counters
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS or STATUS_INVALID_PARAMETER
+ */
+status_t event_feed_get_stats(event_feed_stats_t *stats);
+
+/**
+ * @brief Post an event; use the event_feed_post_*() helpers
+ *
+ * Callers check event_feed_enabled() first. The timestamp is filled in.
+ * The event goes on the feed ring and on the bus ring, each only when
+ * its kind is subscribed to there.
+ */
+void event_feed_post(event_feed_event_t *event);
+
+/**
+ * @brief Post a MAC learn or age event
+ */
+void event_feed_post_mac(event_feed_kind_t kind, const mac_addr_t *mac, vlan_id_t vlan_id,
+                         port_id_t port_id);
+
+/**
+ * @brief Post a link change
+ */
+void event_feed_post_link(port_id_t port_id, uint8_t state);
+
+/**
+ * @brief Post a FIB change
+ *
+ * @param kind EVENT_FEED_ROUTE_ADD, EVENT_FEED_ROUTE_DELETE or EVENT_FEED_ROUTE_CHANGE
+ * @param vrf_id VRF
+ * @param prefix Prefix bytes, 4 or 16 of them
+ * @param prefix_len Prefix length
+ * @param is_ipv6 Whether the prefix is IPv6
+ */
+void event_feed_post_route(event_feed_kind_t kind, uint16_t vrf_id, const uint8_t *prefix,
+                           uint8_t prefix_len, bool is_ipv6);
+
+/**
+ * @brief Post an STP role change
+ */
+void event_feed_post_stp_role(port_id_t port_id, uint8_t old_role, uint8_t new_role);
+
+#endif /* SWITCH_SIM_EVENT_FEED_H */
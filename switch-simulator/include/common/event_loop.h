@@ -0,0 +1,180 @@
+/**
+ * @file event_loop.h
+ * @brief Event-driven main loop with timers for switch simulator
+ *
+ * The event loop waits in epoll for file descriptor events and for the
+ * next timer deadline (a timerfd), so the process sleeps while idle.
+ * Timers live in a four-level hierarchical timer wheel with a tick of
+ * CONFIG_EVENT_LOOP_TICK_US; starting, stopping and expiring a timer
+ * are O(1) regardless of how many timers are pending.
+ *
+ * Time comes from the simulator clock (sim_clock.h). On a virtual clock
+ * the loop does not sleep until a deadline: once no descriptor is ready
+ * it moves the clock to the next timer and runs it at once.
+ *
+ * Timers may be started and stopped from any thread. File descriptor
+ * handlers should be added and removed from the loop thread or before
+ * event_loop_run().
+ */
+
+#ifndef SWITCH_SIM_EVENT_LOOP_H
+#define SWITCH_SIM_EVENT_LOOP_H
+
+#include "types.h"
+#include "error_codes.h"
+
+/**
+ * @brief Intrusive list link used by the timer wheel
+ */
+typedef struct event_link {
+    struct event_link *next;
+    struct event_link *prev;
+} event_link_t;
+
+struct event_timer;
+
+/**
+ * @brief Timer callback, runs on the event loop thread
+ *
+ * The callback may restart or stop any timer, including its own.
+ *
+ * @param timer Expired timer
+ * @param arg User argument given to event_timer_init()
+ */
+typedef void (*event_timer_cb_t)(struct event_timer *timer, void *arg);
+
+/**
+ * @brief File descriptor event callback, runs on the event loop thread
+ *
+ * @param fd File descriptor
+ * @param events Ready events (EPOLLIN, EPOLLOUT, ...)
+ * @param arg User argument given to event_loop_add_fd()
+ */
+typedef void (*event_fd_cb_t)(int fd, uint32_t events, void *arg);
+
+/**
+ * @brief Timer, embedded by its owner; fields are private to the loop
+ */
+typedef struct event_timer {
+    event_link_t link;          /**< Wheel slot link (must be first) */
+    uint64_t expires;           /**< Expiry tick */
+    uint64_t period;            /**< Period in ticks, 0 for one-shot */
+    event_timer_cb_t callback;  /**< Expiry callback */
+    void *arg;                  /**< Callback argument */
+    uint8_t level;              /**< Wheel level holding the timer */
+    uint8_t slot;               /**< Slot within the level */
+    bool pending;               /**< Timer is armed */
+} event_timer_t;
+
+/**
+ * @brief Event loop counters
+ */
+typedef struct {
+    uint64_t timers_pending;    /**< Armed timers */
+    uint64_t timers_fired;      /**< Timer callbacks run */
+    uint64_t wakeups;           /**< epoll_wait() returns */
+    uint64_t fd_events;         /**< File descriptor callbacks run */
+    uint64_t max_lateness_us;   /**< Worst observed delay past a deadline */
+    uint64_t clock_jumps;       /**< Virtual clock moves to a timer deadline */
+} event_loop_stats_t;
+
+/**
+ * @brief Initialize the event loop
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t event_loop_init(void);
+
+/**
+ * @brief Release the event loop
+ *
+ * Pending timers are dropped (not run) and fd handlers are removed.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t event_loop_shutdown(void);
+
+/**
+ * @brief Dispatch events and timers until event_loop_stop() is called
+ *
+ * @return STATUS_SUCCESS when stopped, appropriate error code otherwise
+ */
+status_t event_loop_run(void);
+
+/**
+ * @brief Make event_loop_run() return
+ *
+ * Async-signal-safe; may be called from any thread or a signal handler.
+ */
+void event_loop_stop(void);
+
+/**
+ * @brief Current monotonic time in microseconds
+ *
+ * @return Monotonic time
+ */
+uint64_t event_loop_now_us(void);
+
+/**
+ * @brief Prepare a timer for use
+ *
+ * @param timer Timer to initialize
+ * @param callback Expiry callback
+ * @param arg Callback argument
+ */
+void event_timer_init(event_timer_t *timer, event_timer_cb_t callback, void *arg);
+
+/**
+ * @brief Arm a timer, re-arming it if it is already pending
+ *
+ * @param timer Initialized timer
+ * @param delay_us Time until the first expiry
+ * @param period_us Interval between later expiries, 0 for a one-shot timer
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t event_timer_start(event_timer_t *timer, uint64_t delay_us, uint64_t period_us);
+
+/**
+ * @brief Disarm a timer
+ *
+ * @param timer Timer to stop
+ * @return true if the timer was pending
+ */
+bool event_timer_stop(event_timer_t *timer);
+
+/**
+ * @brief Check if a timer is armed
+ *
+ * @param timer Timer
+ * @return true if pending
+ */
+bool event_timer_pending(const event_timer_t *timer);
+
+/**
+ * @brief Watch a file descriptor
+ *
+ * @param fd File descriptor
+ * @param events epoll event mask
+ * @param callback Event callback
+ * @param arg Callback argument
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t event_loop_add_fd(int fd, uint32_t events, event_fd_cb_t callback, void *arg);
+
+/**
+ * @brief Stop watching a file descriptor
+ *
+ * @param fd File descriptor
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if fd is not watched
+ */
+status_t event_loop_remove_fd(int fd);
+
+/**
+ * @brief Get event loop counters
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t event_loop_get_stats(event_loop_stats_t *stats);
+
+#endif /* SWITCH_SIM_EVENT_LOOP_H */
@@ -0,0 +1,321 @@
+/**
+ * @file event_task.h
+ * @brief Stackless cooperative tasks on the event loop
+ *
+ * A task is a function that runs on the event loop thread and gives the
+ * thread back at the points it marks: it yields, sleeps on a timer or
+ * waits for a queue. The task function is re-entered from the top each
+ * time and the EVENT_TASK_* macros jump to where it left off, so a task
+ * has no stack of its own and costs one event_task_t. Local variables do
+ * not survive a suspension point; keep state in the object the task
+ * argument points to.
+ *
+ *     static int hello_task(event_task_t *task) {
+ *         iface_t *iface = task->arg;
+ *
+ *         EVENT_TASK_BEGIN(task);
+ *         for (;;) {
+ *             EVENT_TASK_POP_TIMEOUT(task, &iface->rx, iface->pkt, iface->hello_us);
+ *             if (iface->pkt == NULL) {
+ *                 send_hello(iface);
+ *             } else {
+ *                 process(iface, iface->pkt);
+ *             }
+ *         }
+ *         EVENT_TASK_END(task);
+ *     }
+ *
+ * Tasks woken from any thread (a queue push, event_task_wake()) go on a
+ * lock-free run queue that the loop drains through an eventfd, so the
+ * control plane sleeps in epoll instead of polling, and forwarding cores
+ * that hand it packets pay one ring enqueue. With CONFIG_CONTROL_PLANE_CPU
+ * set, event_task_init() pins the loop thread to that core.
+ *
+ * A task may not use the macros inside a switch statement of its own, and
+ * a line holds at most one of them: the line number marks the spot.
+ */
+
+#ifndef SWITCH_SIM_EVENT_TASK_H
+#define SWITCH_SIM_EVENT_TASK_H
+
+#include <stddef.h>
+
+#include "types.h"
+#include "error_codes.h"
+#include "event_loop.h"
+#include "ring.h"
+
+/**
+ * @brief What a task function returns; the macros return it for the task
+ */
+#define EVENT_TASK_YIELDED      0   /**< Run again on the next pass */
+#define EVENT_TASK_WAITING      1   /**< Run again once woken */
+#define EVENT_TASK_DONE         2   /**< Finished; the task is released */
+
+/**
+ * @brief Task states
+ */
+typedef enum {
+    EVENT_TASK_IDLE = 0,        /**< Not spawned, or finished */
+    EVENT_TASK_READY,           /**< On the run queue */
+    EVENT_TASK_SLEEPING,        /**< Waiting for a wakeup or its timer */
+    EVENT_TASK_RUNNING,
+} event_task_state_t;
+
+struct event_task;
+
+/**
+ * @brief Task function
+ *
+ * @param task The task; task->arg is the spawn argument
+ * @return EVENT_TASK_YIELDED, EVENT_TASK_WAITING or EVENT_TASK_DONE
+ */
+typedef int (*event_task_fn_t)(struct event_task *task);
+
+/**
+ * @brief Counters of one task
+ */
+typedef struct {
+    uint64_t runs;              /**< Times the function was entered */
+    uint64_t wakeups;           /**< Wakeups that queued the task */
+    uint64_t timeouts;          /**< Sleeps and waits ended by the timer */
+    uint64_t run_ns;            /**< Time spent running */
+    uint64_t max_run_ns;        /**< Longest single run */
+} event_task_stats_t;
+
+/**
+ * @brief Task, embedded by its owner; fields other than arg are private
+ */
+typedef struct event_task {
+    uint32_t resume;            /**< Line to continue at, 0 at the top */
+    event_task_fn_t fn;
+    void *arg;                  /**< Spawn argument */
+    const char *name;
+    uint8_t state;              /**< event_task_state_t */
+    bool queued;                /**< On the run queue or about to be */
+    bool timed_out;             /**< The last wait ended by the timer */
+    event_timer_t timer;
+    struct event_task_queue *wait_queue; /**< Queue the task is registered on */
+    struct event_task *next;    /**< Task list of the runtime */
+    event_task_stats_t stats;
+} event_task_t;
+
+/**
+ * @brief Queue of pointers a task can wait on
+ *
+ * Any thread pushes, only the waiting task pops.
+ */
+typedef struct event_task_queue {
+    ring_t *ring;
+    event_task_t *waiter;       /**< Task to wake on a push */
+    uint64_t dropped;           /**< Pushes refused by a full queue */
+} event_task_queue_t;
+
+/**
+ * @brief Runtime counters
+ */
+typedef struct {
+    uint32_t tasks;             /**< Spawned and not finished */
+    uint64_t passes;            /**< Drains of the run queue */
+    uint64_t runs;              /**< Task function entries */
+    int cpu;                    /**< Control core, -1 if not pinned */
+} event_task_runtime_stats_t;
+
+/**
+ * @brief Start the runtime on the event loop
+ *
+ * Call after event_loop_init() from the thread that runs the loop.
+ *
+ * @param cpu Core to pin that thread to, -1 to leave it
+ * @return STATUS_SUCCESS, STATUS_ALREADY_INITIALIZED, STATUS_NO_MEMORY or
+ *         the error of event_loop_add_fd()
+ */
+status_t event_task_init(int cpu);
+
+/**
+ * @brief Stop the runtime; tasks still spawned are dropped, not run
+ *
+ * @return STATUS_SUCCESS or STATUS_NOT_INITIALIZED
+ */
+status_t event_task_shutdown(void);
+
+/**
+ * @brief Start a task; its first run is on the next pass of the loop
+ *
+ * @param task Task, owned by the caller until it finishes or is cancelled
+ * @param name Name for the report, kept by reference
+ * @param fn Task function
+ * @param arg Argument, as task->arg
+ * @return STATUS_SUCCESS, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ *         or STATUS_ALREADY_EXISTS if the task is already spawned
+ */
+status_t event_task_spawn(event_task_t *task, const char *name, event_task_fn_t fn, void *arg);
+
+/**
+ * @brief Stop a task where it is suspended
+ *
+ * Call from the loop thread, not from the task itself.
+ *
+ * @param task Task
+ */
+void event_task_cancel(event_task_t *task);
+
+/**
+ * @brief Make a sleeping task run again; any thread
+ *
+ * Waking a task that is ready or running is a no-op.
+ *
+ * @param task Task
+ */
+void event_task_wake(event_task_t *task);
+
+/**
+ * @brief Arm the timer of the running task; used by the macros
+ */
+void event_task_arm(event_task_t *task, uint64_t delay_us);
+
+/**
+ * @brief Disarm the timer of the running task; used by the macros
+ */
+void event_task_disarm(event_task_t *task);
+
+/**
+ * @brief Create a queue
+ *
+ * @param queue Queue
+ * @param size Slots, a power of two
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER or STATUS_NO_MEMORY
+ */
+status_t event_task_queue_init(event_task_queue_t *queue, uint32_t size);
+
+/**
+ * @brief Free a queue; items still on it are the caller's
+ *
+ * @param queue Queue
+ */
+void event_task_queue_destroy(event_task_queue_t *queue);
+
+/**
+ * @brief Put an item on a queue and wake its task; any thread
+ *
+ * @param queue Queue
+ * @param item Item, not NULL
+ * @return true if queued, false if the queue is full
+ */
+bool event_task_queue_push(event_task_queue_t *queue, void *item);
+
+/**
+ * @brief Take an item without waiting
+ *
+ * @param queue Queue
+ * @return Item or NULL
+ */
+static inline void *event_task_queue_pop(event_task_queue_t *queue) {
+    void *item = NULL;
+
+    return ring_dequeue(queue->ring, &item) ? item : NULL;
+}
+
+/**
+ * @brief Take an item for the running task, or register it as the waiter
+ *
+ * Used by the macros. The queue is looked at again after registering, so
+ * a push that lands in between is not missed.
+ *
+ * @return Item, or NULL with the task registered
+ */
+void *event_task_queue_take(event_task_queue_t *queue, event_task_t *task);
+
+/**
+ * @brief Stop being the queue's waiter after a timeout; used by the macros
+ */
+void event_task_queue_release(event_task_queue_t *queue, event_task_t *task);
+
+/**
+ * @brief Read the counters of a task
+ */
+static inline void event_task_get_stats(const event_task_t *task, event_task_stats_t *stats) {
+    *stats = task->stats;
+}
+
+/**
+ * @brief Read the runtime counters
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS or STATUS_INVALID_PARAMETER
+ */
+status_t event_task_get_runtime_stats(event_task_runtime_stats_t *stats);
+
+/**
+ * @brief Format the runtime and its tasks as text
+ *
+ * @param output Buffer
+ * @param output_len Buffer size
+ * @return Characters written
+ */
+size_t event_task_report(char *output, size_t output_len);
+
+/* Suspension points, see the example at the top */
+
+#define EVENT_TASK_BEGIN(task)                                                  \
+    switch ((task)->resume) {                                                   \
+    case 0:
+
+#define EVENT_TASK_END(task)                                                    \
+    }                                                                           \
+    (task)->resume = 0;                                                         \
+    return EVENT_TASK_DONE
+
+/** Give the loop back and continue on its next pass */
+#define EVENT_TASK_YIELD(task)                                                  \
+    do {                                                                        \
+        (task)->resume = __LINE__;                                              \
+        return EVENT_TASK_YIELDED;                                              \
+    case __LINE__:;                                                             \
+    } while (0)
+
+/** Sleep for delay_us, or less if something calls event_task_wake() */
+#define EVENT_TASK_SLEEP(task, delay_us)                                        \
+    do {                                                                        \
+        event_task_arm((task), (delay_us));                                     \
+        (task)->resume = __LINE__;                                              \
+        return EVENT_TASK_WAITING;                                              \
+    case __LINE__:                                                              \
+        event_task_disarm(task);                                                \
+    } while (0)
+
+/** Wait until cond holds; it is checked again each time the task is woken */
+#define EVENT_TASK_WAIT_UNTIL(task, cond)                                       \
+    do {                                                                        \
+        (task)->resume = __LINE__;                                              \
+    case __LINE__:                                                              \
+        if (!(cond)) {                                                          \
+            return EVENT_TASK_WAITING;                                          \
+        }                                                                       \
+    } while (0)
+
+/** Take the next item of queue into lvalue, waiting as long as it takes */
+#define EVENT_TASK_POP(task, queue, lvalue)                                     \
+    do {                                                                        \
+        (task)->resume = __LINE__;                                              \
+    case __LINE__:                                                              \
+        if (((lvalue) = event_task_queue_take((queue), (task))) == NULL) {      \
+            return EVENT_TASK_WAITING;                                          \
+        }                                                                       \
+    } while (0)
+
+/** Like EVENT_TASK_POP, giving up after timeout_us with lvalue set to NULL */
+#define EVENT_TASK_POP_TIMEOUT(task, queue, lvalue, timeout_us)                 \
+    do {                                                                        \
+        event_task_arm((task), (timeout_us));                                   \
+        (task)->resume = __LINE__;                                              \
+    case __LINE__:                                                              \
+        if (((lvalue) = event_task_queue_take((queue), (task))) == NULL &&      \
+            !(task)->timed_out) {                                               \
+            return EVENT_TASK_WAITING;                                          \
+        }                                                                       \
+        event_task_queue_release((queue), (task));                              \
+        event_task_disarm(task);                                                \
+    } while (0)
+
+#endif /* SWITCH_SIM_EVENT_TASK_H */
@@ -0,0 +1,73 @@
+/**
+ * @file init_graph.h
+ * @brief Startup steps run in dependency order, independent ones in parallel
+ *
+ * Each step names the earlier steps it needs. A small pool of threads
+ * starts every step whose dependencies are done, so modules that share
+ * nothing initialize at the same time. The time each step took is logged,
+ * along with the total and the sum the steps would take one by one.
+ *
+ * After the first failure no further step is started; those already
+ * running are waited for.
+ */
+
+#ifndef SWITCH_SIM_INIT_GRAPH_H
+#define SWITCH_SIM_INIT_GRAPH_H
+
+#include "types.h"
+#include "error_codes.h"
+
+/**
+ * @brief Largest number of steps of one run
+ */
+#define INIT_GRAPH_MAX_STEPS    64
+
+/**
+ * @brief Dependency on step number s, for init_step_t.after
+ */
+#define INIT_AFTER(s)           (1ULL << (s))
+
+/**
+ * @brief Body of a startup step
+ *
+ * @param arg Argument of the step
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+typedef status_t (*init_step_fn)(void *arg);
+
+/**
+ * @brief One startup step
+ */
+typedef struct {
+    const char *name;           /**< Name for the log */
+    init_step_fn fn;            /**< Body */
+    void *arg;                  /**< Argument of fn */
+    uint64_t after;             /**< INIT_AFTER() of every earlier step it needs */
+} init_step_t;
+
+/**
+ * @brief Outcome of one step
+ */
+typedef struct {
+    status_t status;            /**< Result of fn, STATUS_NOT_EXECUTED if not started */
+    uint64_t elapsed_ns;        /**< Time fn took */
+} init_step_result_t;
+
+/**
+ * @brief Run startup steps
+ *
+ * A step may depend only on steps before it in the array, so the array
+ * order is always a valid serial order; with one thread it is the order
+ * used.
+ *
+ * @param steps Steps
+ * @param count Number of steps, at most INIT_GRAPH_MAX_STEPS
+ * @param threads Threads to use, 0 for one per CPU; the calling thread is one of them
+ * @param[out] results Outcome of every step, may be NULL
+ * @return STATUS_SUCCESS if every step succeeded, the status of the first
+ *         failed step otherwise, STATUS_INVALID_PARAMETER for a bad graph
+ */
+status_t init_graph_run(const init_step_t *steps, uint32_t count, uint32_t threads,
+                        init_step_result_t *results);
+
+#endif /* SWITCH_SIM_INIT_GRAPH_H */
@@ -0,0 +1,99 @@
+/**
+ * @file keyed_hash.h
+ * @brief Keyed hash for tables indexed by addresses the traffic chooses
+ *
+ * The MAC table, the ARP and ND caches, the multicast snooping table and
+ * the route hash are filled from addresses that arrive on the wire or from
+ * peers, so an unkeyed hash lets anyone who knows it aim every key at a few
+ * buckets. They hash with SipHash-1-3 under one 128-bit key drawn when the
+ * first table is initialized: without the key, colliding addresses cannot
+ * be computed, and the outputs of different keys are unrelated.
+ *
+ * The key never changes afterwards, as every table keeps keys where the
+ * hash placed them. CONFIG_KEYED_HASH_SEED derives it from a fixed value
+ * instead, for runs that must place keys the same way every time.
+ */
+
+#ifndef SWITCH_SIM_KEYED_HASH_H
+#define SWITCH_SIM_KEYED_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * @brief Hash key
+ */
+typedef struct {
+    uint64_t k0;
+    uint64_t k1;
+} keyed_hash_key_t;
+
+/** Key of every table, set once by keyed_hash_init() */
+extern keyed_hash_key_t g_keyed_hash_key;
+
+/**
+ * @brief Draw the key, once per process
+ *
+ * Every table calls it from its init before hashing anything; later calls
+ * return at once.
+ */
+void keyed_hash_init(void);
+
+#define KEYED_HASH_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define KEYED_HASH_ROUND(v0, v1, v2, v3)                                       \
+    do {                                                                       \
+        v0 += v1; v1 = KEYED_HASH_ROTL(v1, 13); v1 ^= v0; v0 = KEYED_HASH_ROTL(v0, 32); \
+        v2 += v3; v3 = KEYED_HASH_ROTL(v3, 16); v3 ^= v2;                      \
+        v0 += v3; v3 = KEYED_HASH_ROTL(v3, 21); v3 ^= v0;                      \
+        v2 += v1; v1 = KEYED_HASH_ROTL(v1, 17); v1 ^= v2; v2 = KEYED_HASH_ROTL(v2, 32); \
+    } while (0)
+
+/**
+ * @brief SipHash-1-3 of a byte string
+ *
+ * Inlined, so a length known at the call site unrolls to a handful of
+ * rounds.
+ *
+ * @param data Bytes to hash
+ * @param len Number of bytes
+ * @return uint64_t Hash; any bits of it may be used
+ */
+static inline uint64_t keyed_hash_bytes(const void *data, size_t len) {
+    uint64_t v0 = g_keyed_hash_key.k0 ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = g_keyed_hash_key.k1 ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = g_keyed_hash_key.k0 ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = g_keyed_hash_key.k1 ^ 0x7465646279746573ULL;
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t last = (uint64_t)len << 56;
+    uint64_t m;
+
+    for (; len >= 8; len -= 8, p += 8) {
+        memcpy(&m, p, sizeof(m));
+        v3 ^= m;
+        KEYED_HASH_ROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+    for (size_t i = 0; i < len; i++) {
+        last |= (uint64_t)p[i] << (8 * i);
+    }
+
+    v3 ^= last;
+    KEYED_HASH_ROUND(v0, v1, v2, v3);
+    v0 ^= last;
+    v2 ^= 0xff;
+    KEYED_HASH_ROUND(v0, v1, v2, v3);
+    KEYED_HASH_ROUND(v0, v1, v2, v3);
+    KEYED_HASH_ROUND(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * @brief SipHash-1-3 of one 64-bit word, as of its bytes in host order
+ */
+static inline uint64_t keyed_hash_u64(uint64_t word) {
+    return keyed_hash_bytes(&word, sizeof(word));
+}
+
+#endif /* SWITCH_SIM_KEYED_HASH_H */
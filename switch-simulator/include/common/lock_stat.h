@@ -0,0 +1,147 @@
+/**
+ * @file lock_stat.h
+ * @brief Contention profile of named lock classes
+ *
+ * Built into spinlocks with CONFIG_SPINLOCK_STATS. A lock given a class
+ * with spinlock_set_class() charges every acquisition to it: how often it
+ * was taken, how often it had to wait and for how many backoff pauses,
+ * and histograms of the nanoseconds spent waiting for it and holding it.
+ * Locks of the same role share a class, so the MAC table's stripe locks
+ * are reported as one line, and the counters are updated with relaxed
+ * atomics, as several locks of a class can be held at once.
+ *
+ * Each histogram has one bucket per power of two of nanoseconds: bucket
+ * 0 counts zero, bucket b counts 2^(b-1) to 2^b - 1, and the last bucket
+ * everything from about a second up.
+ */
+
+#ifndef SWITCH_SIM_LOCK_STAT_H
+#define SWITCH_SIM_LOCK_STAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "types.h"
+#include "error_codes.h"
+
+#define LOCK_STAT_MAX_CLASSES   32      /**< Classes that can be registered */
+#define LOCK_STAT_NAME_MAX      32      /**< Longest class name kept, with the terminator */
+#define LOCK_STAT_BUCKETS       32      /**< Histogram buckets */
+
+/**
+ * @brief Counters of a lock class
+ */
+typedef struct lock_stat_class {
+    char name[LOCK_STAT_NAME_MAX];
+    uint64_t acquisitions;                  /**< Times taken */
+    uint64_t contended;                     /**< Times taken after waiting */
+    uint64_t spins;                         /**< Backoff pauses spent waiting */
+    uint64_t wait_ns;                       /**< Total time waited */
+    uint64_t hold_ns;                       /**< Total time held */
+    uint64_t wait_max_ns;
+    uint64_t hold_max_ns;
+    uint64_t wait_hist[LOCK_STAT_BUCKETS];  /**< Waits of contended acquisitions */
+    uint64_t hold_hist[LOCK_STAT_BUCKETS];  /**< Hold times */
+} lock_stat_class_t;
+
+/**
+ * @brief Monotonic time in nanoseconds
+ */
+static inline uint64_t lock_stat_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Histogram bucket of a duration
+ */
+static inline uint32_t lock_stat_bucket(uint64_t ns) {
+    uint32_t bucket = ns ? 64 - (uint32_t)__builtin_clzll(ns) : 0;
+    return bucket < LOCK_STAT_BUCKETS ? bucket : LOCK_STAT_BUCKETS - 1;
+}
+
+static inline void lock_stat_update_max(uint64_t *max, uint64_t value) {
+    uint64_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+    while (value > cur &&
+           !__atomic_compare_exchange_n(max, &cur, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+ * @brief Charge an acquisition to a class
+ *
+ * @param cls Class
+ * @param spins Backoff pauses waited, 0 if the lock was free
+ * @param wait_ns Time waited, for a contended acquisition
+ */
+static inline void lock_stat_record_acquire(lock_stat_class_t *cls, uint64_t spins, uint64_t wait_ns) {
+    __atomic_fetch_add(&cls->acquisitions, 1, __ATOMIC_RELAXED);
+    if (spins == 0) {
+        return;
+    }
+    __atomic_fetch_add(&cls->contended, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cls->spins, spins, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cls->wait_ns, wait_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cls->wait_hist[lock_stat_bucket(wait_ns)], 1, __ATOMIC_RELAXED);
+    lock_stat_update_max(&cls->wait_max_ns, wait_ns);
+}
+
+/**
+ * @brief Charge a hold time to a class
+ */
+static inline void lock_stat_record_hold(lock_stat_class_t *cls, uint64_t hold_ns) {
+    __atomic_fetch_add(&cls->hold_ns, hold_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cls->hold_hist[lock_stat_bucket(hold_ns)], 1, __ATOMIC_RELAXED);
+    lock_stat_update_max(&cls->hold_max_ns, hold_ns);
+}
+
+/**
+ * @brief Find or register a class
+ *
+ * Classes are never freed, so the pointer stays valid for the life of
+ * the process.
+ *
+ * @param name Class name, truncated to LOCK_STAT_NAME_MAX - 1 characters
+ * @return Class, or NULL if LOCK_STAT_MAX_CLASSES are registered
+ */
+lock_stat_class_t *lock_stat_class(const char *name);
+
+/**
+ * @brief Copy the counters of every registered class
+ *
+ * @param[out] classes Array for the copies
+ * @param max Size of classes
+ * @return Number of classes copied
+ */
+uint32_t lock_stat_snapshot(lock_stat_class_t *classes, uint32_t max);
+
+/**
+ * @brief Upper bound of the bucket holding a percentile of a histogram
+ *
+ * @param hist Histogram
+ * @param percentile 0 to 100
+ * @return Nanoseconds, 0 for an empty histogram
+ */
+uint64_t lock_stat_percentile(const uint64_t *hist, double percentile);
+
+/**
+ * @brief Zero the counters of every class
+ */
+void lock_stat_clear(void);
+
+/**
+ * @brief Write one line per class that was taken, most waited-for first
+ *
+ * Wait averages and percentiles are over the contended acquisitions.
+ *
+ * @param buf Output buffer
+ * @param len Size of buf
+ * @return Length of the report, which is truncated if not less than len
+ */
+size_t lock_stat_report(char *buf, size_t len);
+
+#endif /* SWITCH_SIM_LOCK_STAT_H */
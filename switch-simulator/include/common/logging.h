@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include "types.h"
+#include "config.h"
 
 #define LOG_WARN LOG_WARNING
 
@@ -72,6 +73,37 @@ void log_set_level(log_level_t level);
  */
 void log_set_category_level(log_category_t category, log_level_t level);
 
+/**
+ * @brief Switch between synchronous and asynchronous logging
+ *
+ * In asynchronous mode a message costs its caller a record in a per-thread
+ * lock-free ring: level, category, the format, file and function pointers,
+ * which must be string literals, and the raw arguments, with %s strings
+ * copied. A background thread timestamps, formats and writes the records
+ * in time order. A message that finds its thread's ring full is dropped
+ * and the drop is reported. FATAL messages are written synchronously after
+ * everything queued before them.
+ *
+ * Turning asynchronous mode off writes out every queued message.
+ *
+ * @param enable true for asynchronous mode
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t log_set_async(bool enable);
+
+/**
+ * @brief Check if logging is asynchronous
+ */
+bool log_is_async(void);
+
+/**
+ * @brief Wait until every message logged so far has been written
+ *
+ * Returns at once in synchronous mode. Must not be called from a log
+ * output path.
+ */
+void log_flush(void);
+
 /**
  * @brief Log a message
  * 
@@ -102,27 +134,117 @@ void log_message_v(log_level_t level, log_category_t category,
                   const char* file, int line, const char* func,
                   const char* format, va_list args);
 
+/** Slots of g_log_thresholds, a power of two above LOG_CATEGORY_CONTROL */
+#define LOG_THRESHOLD_SLOTS 16
+
+/**
+ * @brief Most detailed level logged per category
+ *
+ * The higher of the global and the category level, kept by log_init(),
+ * log_set_level() and log_set_category_level(). Categories without a
+ * level of their own have the global level.
+ */
+extern uint8_t g_log_thresholds[LOG_THRESHOLD_SLOTS];
+
+/**
+ * @brief Check if a level is compiled in
+ *
+ * Constant for a constant level.
+ */
+#define LOG_LEVEL_COMPILED(level) \
+    ((int)(level) <= CONFIG_LOG_COMPILE_LEVEL + (int)LOG_LEVEL_ERROR)
+
+/**
+ * @brief Check if a message of a level and category would be logged
+ *
+ * @param level Log level
+ * @param category Log category
+ * @return true if the message passes the level filter
+ */
+static inline bool log_level_enabled(log_level_t level, log_category_t category)
+{
+    return (int)level <= (int)__atomic_load_n(&g_log_thresholds[(unsigned)category & (LOG_THRESHOLD_SLOTS - 1)],
+                                              __ATOMIC_RELAXED);
+}
+
 /**
  * @brief Helper macros for logging
+ *
+ * The level is checked before the arguments are evaluated; levels not
+ * compiled in leave no code at all.
  */
+#define LOG_AT_LEVEL(level, category, fmt, ...) \
+    ((LOG_LEVEL_COMPILED(level) && log_level_enabled(level, category)) ? \
+     log_message(level, category, __FILE__, __LINE__, __func__, fmt, ##__VA_ARGS__) : (void)0)
+
 #define LOG_FATAL(category, fmt, ...) \
-    log_message(LOG_LEVEL_FATAL, category, __FILE__, __LINE__, __func__, fmt, ##__VA_ARGS__)
+    LOG_AT_LEVEL(LOG_LEVEL_FATAL, category, fmt, ##__VA_ARGS__)
 
 #define LOG_ERROR(category, fmt, ...) \
-    log_message(LOG_LEVEL_ERROR, category, __FILE__, __LINE__, __func__, fmt, ##__VA_ARGS__)
+    LOG_AT_LEVEL(LOG_LEVEL_ERROR, category, fmt, ##__VA_ARGS__)
                                                                              // ^
                                                                              // GNU extention
 #define LOG_WARNING(category, fmt, ...) \
-    log_message(LOG_LEVEL_WARNING, category, __FILE__, __LINE__, __func__, fmt, ##__VA_ARGS__)
+    LOG_AT_LEVEL(LOG_LEVEL_WARNING, category, fmt, ##__VA_ARGS__)
 
 #define LOG_INFO(category, fmt, ...) \
-    log_message(LOG_LEVEL_INFO, category, __FILE__, __LINE__, __func__, fmt, ##__VA_ARGS__)
+    LOG_AT_LEVEL(LOG_LEVEL_INFO, category, fmt, ##__VA_ARGS__)
 
 #define LOG_DEBUG(category, fmt, ...) \
-    log_message(LOG_LEVEL_DEBUG, category, __FILE__, __LINE__, __func__, fmt, ##__VA_ARGS__)
+    LOG_AT_LEVEL(LOG_LEVEL_DEBUG, category, fmt, ##__VA_ARGS__)
 
 #define LOG_TRACE(category, fmt, ...) \
-    log_message(LOG_LEVEL_TRACE, category, __FILE__, __LINE__, __func__, fmt, ##__VA_ARGS__)
+    LOG_AT_LEVEL(LOG_LEVEL_TRACE, category, fmt, ##__VA_ARGS__)
+
+/**
+ * @brief Rate limit of one call site, see LOG_WARNING_RATELIMITED()
+ */
+typedef struct {
+    uint64_t next_ns;           /**< When the site may log again with a full burst */
+    uint32_t suppressed;        /**< Messages refused since one was logged */
+} log_ratelimit_t;
+
+/**
+ * @brief Take a message from the token bucket of a call site
+ *
+ * A site may log CONFIG_LOG_RATELIMIT_BURST messages back to back and
+ * earns one more every CONFIG_LOG_RATELIMIT_INTERVAL_MS. Lock-free; the
+ * clock is CLOCK_MONOTONIC_COARSE.
+ *
+ * @param limit Rate limit of the site
+ * @param[out] suppressed Messages refused since the last one allowed
+ * @return true if the message may be logged
+ */
+bool log_ratelimit(log_ratelimit_t *limit, uint32_t *suppressed);
+
+/**
+ * @brief Rate-limited logging, for messages that can repeat at packet rate
+ *
+ * Each call site has its own limit. The first message logged after some
+ * were refused is preceded by how many were.
+ */
+#define LOG_AT_LEVEL_RATELIMITED(level, category, fmt, ...) \
+    do { \
+        static log_ratelimit_t log_limit_; \
+        uint32_t log_suppressed_; \
+        if (LOG_LEVEL_COMPILED(level) && log_level_enabled(level, category) && \
+            log_ratelimit(&log_limit_, &log_suppressed_)) { \
+            if (log_suppressed_ > 0) { \
+                log_message(level, category, __FILE__, __LINE__, __func__, \
+                            "%u similar messages suppressed", log_suppressed_); \
+            } \
+            log_message(level, category, __FILE__, __LINE__, __func__, fmt, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_ERROR_RATELIMITED(category, fmt, ...) \
+    LOG_AT_LEVEL_RATELIMITED(LOG_LEVEL_ERROR, category, fmt, ##__VA_ARGS__)
+
+#define LOG_WARNING_RATELIMITED(category, fmt, ...) \
+    LOG_AT_LEVEL_RATELIMITED(LOG_LEVEL_WARNING, category, fmt, ##__VA_ARGS__)
+
+#define LOG_INFO_RATELIMITED(category, fmt, ...) \
+    LOG_AT_LEVEL_RATELIMITED(LOG_LEVEL_INFO, category, fmt, ##__VA_ARGS__)
 
 /**
  * @brief Get string representation of log level
@@ -0,0 +1,140 @@
+/**
+ * @file mem_account.h
+ * @brief Memory footprint of each subsystem
+ *
+ * The tables, pools and caches of the simulator allocate their heap memory
+ * through mem_malloc() and the other wrappers below, giving the subsystem
+ * the memory is charged to. Each subsystem counts the bytes
+ * and objects it holds, the most bytes it ever held, its allocations and
+ * the allocations that failed. Sizes are those malloc_usable_size() reports,
+ * so nothing is added in front of the memory and a pointer from
+ * mem_malloc() can be handed to anything that takes malloc() memory; it
+ * must only be freed with mem_free() and the same tag.
+ *
+ * Counters are updated with relaxed atomics, each subsystem on a cache line
+ * of its own, so the cost is that of malloc() itself. Huge-page arenas keep
+ * their own counters; mem_account_get() adds those of the arenas a
+ * subsystem uses, so the report shows the whole footprint of a subsystem.
+ */
+
+#ifndef SWITCH_SIM_MEM_ACCOUNT_H
+#define SWITCH_SIM_MEM_ACCOUNT_H
+
+#include <stddef.h>
+#include "types.h"
+#include "error_codes.h"
+
+/**
+ * @brief Subsystem memory is charged to
+ */
+typedef enum {
+    MEM_TAG_OTHER = 0,      /**< Memory not charged to a subsystem */
+    MEM_TAG_PACKET,         /**< Packet buffers off the pools, clones, processor tables */
+    MEM_TAG_MAC_TABLE,      /**< MAC table, its aging wheel and snapshots */
+    MEM_TAG_VLAN,           /**< VLAN table, port configuration and translation maps */
+    MEM_TAG_FIB,            /**< RIB, tries, next hops, groups and the hardware queue */
+    MEM_TAG_ARP,            /**< Neighbor rewrites */
+    MEM_TAG_IP,             /**< Reassembly queues and flow caches */
+    MEM_TAG_ACL,            /**< Classifiers, counters and PBR groups */
+    MEM_TAG_MPLS,           /**< Label table */
+    MEM_TAG_CONNTRACK,      /**< Connection tables and NAT rules */
+    MEM_TAG_STATS,          /**< Sharded counters */
+    MEM_TAG_MGMT,           /**< Management server connections and buffers */
+    MEM_TAG_COUNT
+} mem_tag_t;
+
+/**
+ * @brief Footprint of a subsystem
+ */
+typedef struct {
+    uint64_t heap_bytes;            /**< Heap bytes held */
+    uint64_t heap_objects;          /**< Heap allocations held */
+    uint64_t heap_peak_bytes;       /**< Most heap bytes held since the last reset */
+    uint64_t allocations;           /**< Heap allocations made, reallocations included */
+    uint64_t failures;              /**< Heap allocations that failed */
+    uint64_t arena_used_bytes;      /**< Bytes held in the subsystem's arenas */
+    uint64_t arena_peak_bytes;      /**< Most bytes held in them since the last reset */
+    uint64_t arena_mapped_bytes;    /**< Bytes the arenas mapped */
+} mem_account_stats_t;
+
+/**
+ * @brief Allocate memory charged to a subsystem
+ *
+ * @param tag Subsystem
+ * @param size Bytes
+ * @return Memory as from malloc(), NULL on failure
+ */
+void *mem_malloc(mem_tag_t tag, size_t size);
+
+/**
+ * @brief Allocate zeroed memory charged to a subsystem
+ *
+ * @param tag Subsystem
+ * @param count Number of elements
+ * @param size Bytes per element
+ * @return Memory as from calloc(), NULL on failure
+ */
+void *mem_calloc(mem_tag_t tag, size_t count, size_t size);
+
+/**
+ * @brief Allocate aligned memory charged to a subsystem
+ *
+ * @param tag Subsystem
+ * @param align Alignment, a power of two multiple of sizeof(void *)
+ * @param size Bytes
+ * @return Memory as from posix_memalign(), NULL on failure
+ */
+void *mem_aligned_alloc(mem_tag_t tag, size_t align, size_t size);
+
+/**
+ * @brief Resize memory of a subsystem
+ *
+ * @param tag Subsystem ptr was allocated for
+ * @param ptr Memory, may be NULL
+ * @param size New size in bytes
+ * @return Memory as from realloc(), NULL on failure with ptr left allocated
+ */
+void *mem_realloc(mem_tag_t tag, void *ptr, size_t size);
+
+/**
+ * @brief Free memory of a subsystem
+ *
+ * @param tag Subsystem ptr was allocated for
+ * @param ptr Memory, may be NULL
+ */
+void mem_free(mem_tag_t tag, void *ptr);
+
+/**
+ * @brief Name of a subsystem
+ *
+ * @param tag Subsystem
+ * @return Name, "unknown" for a value out of range
+ */
+const char *mem_tag_name(mem_tag_t tag);
+
+/**
+ * @brief Get the footprint of a subsystem
+ *
+ * @param tag Subsystem
+ * @param[out] stats Footprint
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t mem_account_get(mem_tag_t tag, mem_account_stats_t *stats);
+
+/**
+ * @brief Restart every high-water mark from what is held now
+ *
+ * The arenas' marks are restarted too.
+ */
+void mem_account_reset_peaks(void);
+
+/**
+ * @brief Write one line per subsystem holding memory, and the totals
+ *
+ * @param buf Output buffer
+ * @param len Size of buf
+ * @return Length of the report, which is truncated if not less than len
+ */
+size_t mem_account_report(char *buf, size_t len);
+
+#endif /* SWITCH_SIM_MEM_ACCOUNT_H */
@@ -0,0 +1,131 @@
+/**
+ * @file mem_arena.h
+ * @brief Huge-page backed memory arenas for large tables and pools
+ *
+ * An arena maps memory in blocks of CONFIG_MEM_ARENA_BLOCK_SIZE and hands
+ * it out by bumping a pointer, so the packet pools, the MAC table, the ARP
+ * pool and the FIB sit on few, large pages and their lookups miss the TLB
+ * far less often. A block is mapped with explicit huge pages (MAP_HUGETLB,
+ * 1GB pages for mappings of a whole number of gigabytes) when the kernel
+ * has some reserved, otherwise aligned to 2MB and offered to transparent
+ * huge pages, otherwise with normal pages.
+ *
+ * Allocations larger than half a block get a mapping of their own. Memory
+ * freed with mem_arena_free() goes back to the system once every
+ * allocation of its block is freed. Memory from an arena is always zeroed.
+ *
+ * Every arena is listed by name for mem_arena_get_stats_by_name(), which
+ * hw_resources_get_usage() reports from.
+ */
+
+#ifndef SWITCH_SIM_MEM_ARENA_H
+#define SWITCH_SIM_MEM_ARENA_H
+
+#include <stddef.h>
+#include "types.h"
+#include "error_codes.h"
+
+/**
+ * @brief Longest arena name, with the terminator
+ */
+#define MEM_ARENA_NAME_LEN      32
+
+/**
+ * @brief Memory arena
+ */
+typedef struct mem_arena mem_arena_t;
+
+/**
+ * @brief Usage of an arena, or of every arena of one name
+ */
+typedef struct {
+    char name[MEM_ARENA_NAME_LEN];  /**< Arena name */
+    uint32_t arenas;                /**< Arenas counted */
+    uint32_t blocks;                /**< Mappings held */
+    uint64_t mapped_bytes;          /**< Bytes mapped */
+    uint64_t used_bytes;            /**< Bytes handed out and not freed */
+    uint64_t peak_used_bytes;       /**< Most bytes handed out at once since the last reset, summed over the arenas */
+    uint64_t hugetlb_bytes;         /**< Mapped bytes on explicit huge pages */
+    uint64_t thp_bytes;             /**< Mapped bytes offered to transparent huge pages */
+    uint64_t page_size;             /**< Largest page size of the mappings */
+    uint64_t allocations;           /**< Allocations made */
+    uint64_t hugetlb_fallbacks;     /**< Mappings that found no explicit huge pages */
+} mem_arena_stats_t;
+
+/**
+ * @brief Create an arena
+ *
+ * Nothing is mapped until the first allocation.
+ *
+ * @param name Name the arena is reported by; arenas may share a name
+ * @return Arena, NULL on failure
+ */
+mem_arena_t *mem_arena_create(const char *name);
+
+/**
+ * @brief Get the arena of a name, creating it on first use
+ *
+ * For the process-wide arenas of the tables and pools, which are never
+ * destroyed; their memory goes back to the system as it is freed.
+ *
+ * @param name Arena name
+ * @return Arena, NULL on failure
+ */
+mem_arena_t *mem_arena_get(const char *name);
+
+/**
+ * @brief Destroy an arena and unmap all its memory
+ *
+ * @param arena Arena, may be NULL
+ */
+void mem_arena_destroy(mem_arena_t *arena);
+
+/**
+ * @brief Allocate zeroed memory
+ *
+ * Thread-safe.
+ *
+ * @param arena Arena
+ * @param size Bytes
+ * @param align Alignment, a power of two up to 2MB; 0 for 16
+ * @return Memory, NULL on failure
+ */
+void *mem_arena_alloc(mem_arena_t *arena, size_t size, size_t align);
+
+/**
+ * @brief Free memory of mem_arena_alloc()
+ *
+ * The memory is unmapped once every allocation sharing its block is
+ * freed; until then it stays mapped and is not reused.
+ *
+ * @param arena Arena the memory came from
+ * @param ptr Memory, may be NULL
+ * @param size Bytes given to mem_arena_alloc()
+ */
+void mem_arena_free(mem_arena_t *arena, void *ptr, size_t size);
+
+/**
+ * @brief Get the usage of an arena
+ *
+ * @param arena Arena
+ * @param[out] stats Usage
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER for NULL arguments
+ */
+status_t mem_arena_get_stats(mem_arena_t *arena, mem_arena_stats_t *stats);
+
+/**
+ * @brief Get the usage of every arena of one name, summed
+ *
+ * @param name Arena name
+ * @param[out] stats Usage
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if no arena has the name,
+ *         STATUS_INVALID_PARAMETER for NULL arguments
+ */
+status_t mem_arena_get_stats_by_name(const char *name, mem_arena_stats_t *stats);
+
+/**
+ * @brief Restart the high-water mark of every arena from its usage now
+ */
+void mem_arena_reset_peaks(void);
+
+#endif /* SWITCH_SIM_MEM_ARENA_H */
@@ -0,0 +1,142 @@
+/**
+ * @file perf_counters.h
+ * @brief Hardware performance counters around code regions
+ *
+ * A small wrapper of perf_event_open(2). A counter group counts cycles,
+ * instructions, last level cache misses, branch misses and data TLB load
+ * misses of the calling thread in user space. Reading the group twice and
+ * taking the difference gives the counts of the code in between:
+ *
+ *     perf_counters_t *pc = perf_counters_thread();
+ *     perf_sample_t before, after, delta;
+ *
+ *     perf_counters_read(pc, &before);
+ *     ... region ...
+ *     perf_counters_read(pc, &after);
+ *     perf_sample_delta(&before, &after, &delta);
+ *
+ * Events the CPU or the kernel does not offer (as in most VMs, or with a
+ * strict perf_event_paranoid) are left out and read as 0; the mask of a
+ * group tells which are counted. Counts are scaled when the kernel had to
+ * multiplex the group. A read is one system call, so regions should be
+ * bursts or whole benchmark runs rather than single operations.
+ */
+
+#ifndef SWITCH_SIM_PERF_COUNTERS_H
+#define SWITCH_SIM_PERF_COUNTERS_H
+
+#include "types.h"
+#include "error_codes.h"
+#include "config.h"
+
+/**
+ * @brief Counted events
+ */
+typedef enum {
+    PERF_COUNTER_CYCLES = 0,        /**< CPU cycles */
+    PERF_COUNTER_INSTRUCTIONS,      /**< Retired instructions */
+    PERF_COUNTER_CACHE_MISSES,      /**< Last level cache misses */
+    PERF_COUNTER_BRANCH_MISSES,     /**< Mispredicted branches */
+    PERF_COUNTER_DTLB_MISSES,       /**< Data TLB load misses */
+    PERF_COUNTER_COUNT
+} perf_counter_t;
+
+/**
+ * @brief Counter group of one thread
+ */
+typedef struct {
+    int leader;                             /**< Group leader fd, -1 if closed */
+    int fds[PERF_COUNTER_COUNT];            /**< Event fds, -1 for events not counted */
+    uint8_t slot[PERF_COUNTER_COUNT];       /**< Position of each event in a group read */
+    uint32_t nr;                            /**< Events in the group */
+    uint32_t mask;                          /**< Bit per counted perf_counter_t */
+} perf_counters_t;
+
+/**
+ * @brief Counter values, indexed by perf_counter_t
+ */
+typedef struct {
+    uint64_t values[PERF_COUNTER_COUNT];
+} perf_sample_t;
+
+/**
+ * @brief Open a counter group for the calling thread
+ *
+ * @param[out] pc Group
+ * @return STATUS_SUCCESS if at least one event is counted,
+ *         STATUS_NOT_SUPPORTED if none could be opened,
+ *         STATUS_INVALID_PARAMETER
+ */
+status_t perf_counters_open(perf_counters_t *pc);
+
+/**
+ * @brief Close a counter group
+ *
+ * @param pc Group, may be closed already
+ */
+void perf_counters_close(perf_counters_t *pc);
+
+/**
+ * @brief Read a counter group
+ *
+ * @param pc Group opened on the calling thread
+ * @param[out] sample Counts since the group was opened
+ * @return STATUS_SUCCESS, STATUS_RESOURCE_UNAVAILABLE if the group has
+ *         not been scheduled on a CPU yet, STATUS_FAILURE if the read failed
+ */
+status_t perf_counters_read(const perf_counters_t *pc, perf_sample_t *sample);
+
+/**
+ * @brief Counter group of the calling thread, opened on first use
+ *
+ * The group is closed when the thread exits.
+ *
+ * @return The group, or NULL if the system counts none of the events
+ */
+perf_counters_t *perf_counters_thread(void);
+
+/**
+ * @brief Short name of an event, such as "llc-misses"
+ */
+const char *perf_counter_name(perf_counter_t counter);
+
+/**
+ * @brief Whether a region was more memory-bound or compute-bound
+ *
+ * Memory-bound when the region misses the last level cache at least
+ * CONFIG_PERF_MEMORY_BOUND_MPKI times per thousand instructions, or the
+ * data TLB as often.
+ *
+ * @param sample Counts of the region
+ * @return "memory", "compute", or "unknown" without instruction counts
+ */
+const char *perf_sample_bound(const perf_sample_t *sample);
+
+/**
+ * @brief Counts of a region from the samples at its ends
+ */
+static inline void perf_sample_delta(const perf_sample_t *start, const perf_sample_t *end,
+                                     perf_sample_t *delta) {
+    for (uint32_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+        delta->values[i] = end->values[i] >= start->values[i] ? end->values[i] - start->values[i] : 0;
+    }
+}
+
+/**
+ * @brief Add the counts of a region to a total
+ */
+static inline void perf_sample_add(perf_sample_t *total, const perf_sample_t *delta) {
+    for (uint32_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+        total->values[i] += delta->values[i];
+    }
+}
+
+/**
+ * @brief Instructions per cycle, 0 without both counts
+ */
+static inline double perf_sample_ipc(const perf_sample_t *sample) {
+    return sample->values[PERF_COUNTER_CYCLES] ?
+           (double)sample->values[PERF_COUNTER_INSTRUCTIONS] / (double)sample->values[PERF_COUNTER_CYCLES] : 0.0;
+}
+
+#endif /* SWITCH_SIM_PERF_COUNTERS_H */
@@ -0,0 +1,121 @@
+/**
+ * @file rcu.h
+ * @brief Epoch-based read-copy-update for read-mostly tables
+ *
+ * Writers build a new immutable copy of a table, publish it with a
+ * single atomic pointer store and hand the old copy to rcu_retire().
+ * Readers bracket their accesses with rcu_read_lock()/rcu_read_unlock();
+ * they never block and never write shared cache lines other than their
+ * own reader record. A retired object is freed once every read section
+ * that could still have loaded it has ended.
+ *
+ * Read sections nest, so a packet that is recirculated through code
+ * that takes its own read section is fine. Writers serialize among
+ * themselves with their own locks; rcu_retire() may be called from any
+ * thread, including from inside a read section.
+ *
+ * Forwarding workers that loop over bursts can instead register for
+ * quiescent-state-based reclamation (QSBR): a registered worker is taken
+ * to be reading at all times, except when it reports a quiescent state
+ * between bursts with rcu_quiescent_state() or goes offline around a
+ * sleep. Its read sections then cost nothing beyond a nesting count, and
+ * the grace period ends once every registered worker has passed a
+ * quiescent state.
+ */
+
+#ifndef SWITCH_SIM_RCU_H
+#define SWITCH_SIM_RCU_H
+
+#include "types.h"
+#include "error_codes.h"
+
+/**
+ * @brief Header embedded in every object that is retired through RCU
+ */
+typedef struct rcu_head {
+    struct rcu_head *next;                  /**< Retired list link */
+    uint64_t retire_epoch;                  /**< Epoch in which the object was replaced */
+    void (*free_fn)(struct rcu_head *head); /**< Destructor called after the grace period */
+} rcu_head_t;
+
+/**
+ * @brief Destructor for a retired object
+ *
+ * @param head RCU header embedded in the object
+ */
+typedef void (*rcu_free_fn_t)(rcu_head_t *head);
+
+/**
+ * @brief Enter a read section on the calling thread
+ *
+ * The first call on a thread registers a reader record, which is the
+ * only step that can fail.
+ *
+ * @return STATUS_SUCCESS, or STATUS_NO_MEMORY if the reader record could
+ *         not be allocated (the caller must not dereference RCU pointers)
+ */
+status_t rcu_read_lock(void);
+
+/**
+ * @brief Leave a read section entered with rcu_read_lock()
+ */
+void rcu_read_unlock(void);
+
+/**
+ * @brief Register the calling thread as a QSBR worker, online
+ *
+ * Until it reports a quiescent state or goes offline, the worker holds
+ * back reclamation as if it were in a read section.
+ *
+ * @return STATUS_SUCCESS, STATUS_ALREADY_INITIALIZED if already
+ *         registered, or STATUS_NO_MEMORY
+ */
+status_t rcu_register_worker(void);
+
+/**
+ * @brief Stop being a QSBR worker; the thread holds no RCU pointers
+ */
+void rcu_unregister_worker(void);
+
+/**
+ * @brief Report that the calling worker holds no RCU pointers
+ *
+ * Call between bursts, outside any read section. No-op on a thread
+ * that is not a registered worker.
+ */
+void rcu_quiescent_state(void);
+
+/**
+ * @brief Take the calling worker offline, e.g. before it sleeps
+ *
+ * An offline worker does not hold back reclamation and must not
+ * dereference RCU pointers.
+ */
+void rcu_worker_offline(void);
+
+/**
+ * @brief Bring the calling worker back online after rcu_worker_offline()
+ */
+void rcu_worker_online(void);
+
+/**
+ * @brief Retire an object that has been unpublished
+ *
+ * The object must already be unreachable for new readers. free_fn is
+ * called once no read section that started before this call remains.
+ * Also frees any previously retired objects whose grace period is over.
+ *
+ * @param head RCU header embedded in the object
+ * @param free_fn Destructor, called with head
+ */
+void rcu_retire(rcu_head_t *head, rcu_free_fn_t free_fn);
+
+/**
+ * @brief Wait for current readers and free everything retired so far
+ *
+ * Must not be called from inside a read section. A registered worker
+ * calling it reports a quiescent state first.
+ */
+void rcu_synchronize(void);
+
+#endif /* SWITCH_SIM_RCU_H */
@@ -0,0 +1,227 @@
+/**
+ * @file ring.h
+ * @brief Bounded lock-free rings of pointers, any number of producers and consumers
+ *
+ * A ring holds pointers in a power-of-two array indexed by free-running
+ * 32-bit counters. Each side has a head, advanced to reserve slots, and a
+ * tail, advanced once the reserved slots are written (producer) or read
+ * (consumer). With several threads on a side, a thread reserves its slots
+ * with one compare-and-swap of the head, copies them, and then waits for
+ * the threads that reserved before it to move the tail up to its own
+ * reservation; a side created single-threaded skips the compare-and-swap.
+ * Producer and consumer counters live on separate cache lines.
+ *
+ * Bursts are all-or-some: a burst call moves as many pointers as fit or
+ * are queued, up to the count asked, with one reservation. For exactly one
+ * producer and one consumer of packets, packet_ring.h is lighter still.
+ */
+
+#ifndef SWITCH_SIM_RING_H
+#define SWITCH_SIM_RING_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "threading.h"
+
+#define RING_CACHE_LINE     64
+#define RING_MAX_SIZE       (1U << 31)
+
+#define RING_F_SP_ENQ       0x1     /**< Only one thread ever enqueues */
+#define RING_F_SC_DEQ       0x2     /**< Only one thread ever dequeues */
+
+/**
+ * @brief Head and tail of one side of a ring
+ */
+typedef struct {
+    volatile uint32_t head;         /**< Next slot to reserve */
+    volatile uint32_t tail;         /**< Slots below this one are complete */
+    bool single;                    /**< One thread on this side */
+} ring_side_t;
+
+/**
+ * @brief Ring of pointers
+ */
+typedef struct {
+    /* Read-only after creation */
+    uint32_t size;                  /**< Number of slots (power of two) */
+    uint32_t mask;                  /**< size - 1 */
+    uint32_t flags;                 /**< RING_F_* */
+
+    ring_side_t prod __attribute__((aligned(RING_CACHE_LINE)));
+    ring_side_t cons __attribute__((aligned(RING_CACHE_LINE)));
+
+    void *slots[] __attribute__((aligned(RING_CACHE_LINE)));
+} ring_t;
+
+/**
+ * @brief Memory of a ring of size slots
+ *
+ * @param size Number of slots
+ * @return Bytes
+ */
+static inline size_t ring_bytes(uint32_t size) {
+    return sizeof(ring_t) + (size_t)size * sizeof(void *);
+}
+
+/**
+ * @brief Allocate an empty ring
+ *
+ * @param size Number of slots, a power of two up to RING_MAX_SIZE
+ * @param flags RING_F_SP_ENQ and RING_F_SC_DEQ, or 0
+ * @return New ring, or NULL on invalid size or allocation failure
+ */
+static inline ring_t *ring_create(uint32_t size, uint32_t flags) {
+    ring_t *ring = NULL;
+
+    if (size == 0 || size > RING_MAX_SIZE || (size & (size - 1)) != 0) {
+        return NULL;
+    }
+    if (posix_memalign((void **)&ring, RING_CACHE_LINE, ring_bytes(size)) != 0) {
+        return NULL;
+    }
+    memset(ring, 0, ring_bytes(size));
+    ring->size = size;
+    ring->mask = size - 1;
+    ring->flags = flags;
+    ring->prod.single = (flags & RING_F_SP_ENQ) != 0;
+    ring->cons.single = (flags & RING_F_SC_DEQ) != 0;
+    return ring;
+}
+
+/**
+ * @brief Free a ring; the pointers still queued are not touched
+ *
+ * @param ring Ring to free (may be NULL)
+ */
+static inline void ring_destroy(ring_t *ring) {
+    free(ring);
+}
+
+/**
+ * @brief Reserve up to n slots on one side of a ring
+ *
+ * @param self Side being advanced
+ * @param other_tail Tail of the other side, bounding the reservation
+ * @param capacity size for the producer side, 0 for the consumer side
+ * @param n Slots wanted
+ * @param[out] start First slot reserved
+ * @return Slots reserved
+ */
+static inline uint32_t ring_reserve(ring_side_t *self, volatile uint32_t *other_tail,
+                                    uint32_t capacity, uint32_t n, uint32_t *start) {
+    uint32_t head = __atomic_load_n(&self->head, __ATOMIC_RELAXED);
+    uint32_t count;
+
+    for (;;) {
+        /*
+         * Keep the head read, here or by a failed compare-and-swap, before
+         * the other tail read; otherwise a stale tail against a newer head
+         * makes avail wrap and over-reserve.
+         */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        /* Pairs with the other side's tail release: its slots are done */
+        uint32_t avail = capacity + __atomic_load_n(other_tail, __ATOMIC_ACQUIRE) - head;
+        count = n < avail ? n : avail;
+        if (count == 0) {
+            return 0;
+        }
+        if (self->single) {
+            self->head = head + count;
+            break;
+        }
+        if (__atomic_compare_exchange_n(&self->head, &head, head + count, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    *start = head;
+    return count;
+}
+
+/**
+ * @brief Publish slots reserved with ring_reserve() once they are done
+ *
+ * Reservations complete in the order they were made.
+ */
+static inline void ring_complete(ring_side_t *self, uint32_t start, uint32_t count) {
+    if (!self->single) {
+        // Acquire the earlier reservation's release so its slots are published along with ours
+        while (__atomic_load_n(&self->tail, __ATOMIC_ACQUIRE) != start) {
+            cpu_relax();
+        }
+    }
+    __atomic_store_n(&self->tail, start + count, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Add up to n pointers to a ring
+ *
+ * @param ring Ring
+ * @param objs Pointers to add
+ * @param n Number of pointers
+ * @return Number added, a prefix of objs; the rest stay with the caller
+ */
+static inline uint32_t ring_enqueue_burst(ring_t *ring, void *const *objs, uint32_t n) {
+    uint32_t start;
+    uint32_t count = ring_reserve(&ring->prod, &ring->cons.tail, ring->size, n, &start);
+
+    for (uint32_t i = 0; i < count; i++) {
+        ring->slots[(start + i) & ring->mask] = objs[i];
+    }
+    if (count > 0) {
+        ring_complete(&ring->prod, start, count);
+    }
+    return count;
+}
+
+/**
+ * @brief Take up to n pointers from a ring
+ *
+ * @param ring Ring
+ * @param[out] objs Pointers taken
+ * @param n Maximum number to take
+ * @return Number taken
+ */
+static inline uint32_t ring_dequeue_burst(ring_t *ring, void **objs, uint32_t n) {
+    uint32_t start;
+    uint32_t count = ring_reserve(&ring->cons, &ring->prod.tail, 0, n, &start);
+
+    for (uint32_t i = 0; i < count; i++) {
+        objs[i] = ring->slots[(start + i) & ring->mask];
+    }
+    if (count > 0) {
+        ring_complete(&ring->cons, start, count);
+    }
+    return count;
+}
+
+static inline bool ring_enqueue(ring_t *ring, void *obj) {
+    return ring_enqueue_burst(ring, &obj, 1) == 1;
+}
+
+static inline bool ring_dequeue(ring_t *ring, void **obj) {
+    return ring_dequeue_burst(ring, obj, 1) == 1;
+}
+
+/**
+ * @brief Number of pointers queued (approximate from other threads)
+ */
+static inline uint32_t ring_count(const ring_t *ring) {
+    /* Consumer first, so the producer tail read after it is never behind */
+    uint32_t cons = __atomic_load_n(&ring->cons.tail, __ATOMIC_ACQUIRE);
+    uint32_t count = __atomic_load_n(&ring->prod.tail, __ATOMIC_ACQUIRE) - cons;
+    return count > ring->size ? ring->size : count;
+}
+
+/**
+ * @brief Number of free slots (approximate from other threads)
+ */
+static inline uint32_t ring_free_count(const ring_t *ring) {
+    return ring->size - ring_count(ring);
+}
+
+#endif /* SWITCH_SIM_RING_H */
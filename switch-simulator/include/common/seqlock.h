@@ -0,0 +1,75 @@
+/**
+ * @file seqlock.h
+ * @brief Sequence locks for small records read far more often than written
+ *
+ * A writer makes the sequence odd, changes the record and makes it even
+ * again. A reader notes an even sequence, copies what it needs and checks
+ * that the sequence has not moved; if it has, the copy may be torn and
+ * the reader tries again. Readers write nothing shared, so any number of
+ * them read at once without bouncing a cache line between them.
+ *
+ * Writers serialize among themselves with their own lock. The protected
+ * fields must be read and written with relaxed atomic accesses, as
+ * readers may load them while a writer stores.
+ */
+
+#ifndef SWITCH_SIM_SEQLOCK_H
+#define SWITCH_SIM_SEQLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "threading.h"
+
+/**
+ * @brief Sequence lock
+ */
+typedef struct {
+    uint32_t seq;       /**< Odd while a writer changes the record */
+} seqlock_t;
+
+static inline void seqlock_init(seqlock_t *lock) {
+    __atomic_store_n(&lock->seq, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Start a read, waiting out a writer in progress
+ *
+ * @return Sequence to pass to seqlock_read_retry()
+ */
+static inline uint32_t seqlock_read_begin(const seqlock_t *lock) {
+    uint32_t seq;
+
+    while ((seq = __atomic_load_n(&lock->seq, __ATOMIC_ACQUIRE)) & 1) {
+        cpu_relax();
+    }
+    return seq;
+}
+
+/**
+ * @brief Check whether a read must be repeated
+ *
+ * @param lock Sequence lock
+ * @param seq Value returned by seqlock_read_begin()
+ * @return true if a writer changed the record during the read
+ */
+static inline bool seqlock_read_retry(const seqlock_t *lock, uint32_t seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&lock->seq, __ATOMIC_RELAXED) != seq;
+}
+
+/**
+ * @brief Start changing the record; the caller holds the writers' lock
+ */
+static inline void seqlock_write_begin(seqlock_t *lock) {
+    __atomic_store_n(&lock->seq, lock->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Publish the changes made since seqlock_write_begin()
+ */
+static inline void seqlock_write_end(seqlock_t *lock) {
+    __atomic_store_n(&lock->seq, lock->seq + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* SWITCH_SIM_SEQLOCK_H */
@@ -0,0 +1,90 @@
+/**
+ * @file sim_clock.h
+ * @brief Simulator clock, real or virtual
+ *
+ * Control-plane time comes from here: event loop timers, protocol ages
+ * and the timestamps of received packets. In real-time mode the clock is
+ * the system clock. In virtual mode it stands still while the simulator
+ * works and moves only when told to; the event loop moves it to the next
+ * timer deadline whenever it has nothing else to do, so hours of aging,
+ * hello and garbage collection timers run in seconds, and in the same
+ * order on every run.
+ *
+ * Data-plane timing (policers, the ASIC timing model, profiling) keeps
+ * using the system clock.
+ *
+ * The mode is meant to be chosen once, before event_loop_init(): the
+ * virtual clock starts where the real one was, but going back to real
+ * time throws away whatever time was skipped.
+ */
+
+#ifndef SWITCH_SIM_SIM_CLOCK_H
+#define SWITCH_SIM_SIM_CLOCK_H
+
+#include <time.h>
+#include "types.h"
+#include "error_codes.h"
+
+/**
+ * @brief Where the simulator clock comes from
+ */
+typedef enum {
+    SIM_CLOCK_REALTIME = 0,     /**< System clock */
+    SIM_CLOCK_VIRTUAL           /**< Moves only by sim_clock_advance_to_us() */
+} sim_clock_mode_t;
+
+/**
+ * @brief Select real or virtual time
+ *
+ * @param mode Clock mode
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER for a bad mode
+ */
+status_t sim_clock_set_mode(sim_clock_mode_t mode);
+
+/**
+ * @brief Get the clock mode
+ *
+ * @return Current mode
+ */
+sim_clock_mode_t sim_clock_get_mode(void);
+
+/**
+ * @brief Check whether the clock is virtual
+ *
+ * @return true in virtual mode
+ */
+bool sim_clock_is_virtual(void);
+
+/**
+ * @brief Monotonic time in microseconds
+ *
+ * @return Current time
+ */
+uint64_t sim_clock_now_us(void);
+
+/**
+ * @brief Wall-clock time in seconds, the simulator's time(NULL)
+ *
+ * @return Seconds since the Unix epoch
+ */
+time_t sim_clock_time(void);
+
+/**
+ * @brief Move the virtual clock forward to a monotonic time
+ *
+ * A time already passed leaves the clock where it is.
+ *
+ * @param target_us Monotonic time, as sim_clock_now_us() reports it
+ * @return STATUS_SUCCESS on success, STATUS_NOT_SUPPORTED in real-time mode
+ */
+status_t sim_clock_advance_to_us(uint64_t target_us);
+
+/**
+ * @brief Move the virtual clock forward
+ *
+ * @param delta_us Microseconds to skip
+ * @return STATUS_SUCCESS on success, STATUS_NOT_SUPPORTED in real-time mode
+ */
+status_t sim_clock_advance_us(uint64_t delta_us);
+
+#endif /* SWITCH_SIM_SIM_CLOCK_H */
@@ -0,0 +1,99 @@
+/**
+ * @file sim_numa.h
+ * @brief NUMA topology and memory placement
+ *
+ * The node layout is read from sysfs the first time it is needed; without
+ * it, or on a single-socket host, there is one node and every placement
+ * call is a no-op. Memory is placed with mbind(2) directly, so nothing
+ * beyond the C library is needed.
+ *
+ * Data touched by one worker (its queues, its port rings, its share of
+ * the packet pool) goes on that worker's node. Read-mostly tables can be
+ * kept as one copy per node with CONFIG_NUMA_REPLICATE_TABLES.
+ */
+
+#ifndef SWITCH_SIM_SIM_NUMA_H
+#define SWITCH_SIM_SIM_NUMA_H
+
+#include <stddef.h>
+#include "types.h"
+#include "error_codes.h"
+
+/**
+ * @brief Number of NUMA nodes, at most CONFIG_NUMA_MAX_NODES
+ *
+ * @return Node count, 1 if the host has no NUMA information
+ */
+uint32_t sim_numa_node_count(void);
+
+/**
+ * @brief Node a CPU belongs to
+ *
+ * @param cpu CPU number
+ * @return Node, 0 for an unknown CPU
+ */
+uint32_t sim_numa_node_of_cpu(uint32_t cpu);
+
+/**
+ * @brief Node of the calling thread
+ *
+ * Looked up once per thread; meant for threads pinned to CPUs of one node.
+ *
+ * @return Node
+ */
+uint32_t sim_numa_current_node(void);
+
+/**
+ * @brief Check whether read-mostly tables keep a copy per node
+ *
+ * @return true with CONFIG_NUMA_REPLICATE_TABLES on a host of several nodes
+ */
+bool sim_numa_replicate_tables(void);
+
+/**
+ * @brief Move memory to a node
+ *
+ * Only the pages wholly inside the range are placed, so memory sharing a
+ * page with other allocations stays where it is.
+ *
+ * @param addr Start of the memory
+ * @param size Bytes
+ * @param node Node
+ * @return STATUS_SUCCESS on success or with one node, STATUS_INVALID_PARAMETER
+ *         for a bad node, STATUS_FAILURE if the kernel refused
+ */
+status_t sim_numa_bind_memory(void *addr, size_t size, uint32_t node);
+
+/**
+ * @brief Allocate zeroed memory on a node
+ *
+ * Whole pages; for data that is big, or that must not share a page with
+ * memory of another node.
+ *
+ * @param size Bytes
+ * @param node Node
+ * @return Memory, NULL on failure; free with sim_numa_free()
+ */
+void *sim_numa_alloc(size_t size, uint32_t node);
+
+/**
+ * @brief Free memory of sim_numa_alloc()
+ *
+ * @param addr Memory, may be NULL
+ * @param size Bytes given to sim_numa_alloc()
+ */
+void sim_numa_free(void *addr, size_t size);
+
+/**
+ * @brief Parse a CPU list such as "0-3,8,10-11"
+ *
+ * The format of sysfs cpulist files and of CONFIG_WORKER_CPU_LIST.
+ *
+ * @param list CPU list
+ * @param[out] cpus CPUs in list order
+ * @param max Size of cpus
+ * @return Number of CPUs stored, 0 for an empty or malformed list
+ */
+uint32_t sim_numa_parse_cpu_list(const char *list, uint32_t *cpus, uint32_t max);
+
+#endif /* SWITCH_SIM_SIM_NUMA_H */
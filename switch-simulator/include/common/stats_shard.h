@@ -0,0 +1,122 @@
+/**
+ * @file stats_shard.h
+ * @brief Per-thread sharded counters for data path statistics
+ *
+ * A counter set is an array of 64-bit counters of which every thread that
+ * counts gets its own cache-line-aligned copy, its shard. A thread only
+ * ever writes its own shard, with plain relaxed stores, so counting takes
+ * no lock and shares no cache line with another thread. Readers fold the
+ * shards of all threads into one value.
+ *
+ * Clearing does not touch the shards: it records the current totals as a
+ * baseline that later reads subtract. The shard of a thread that exits
+ * is kept, with its counts, for the next thread that joins the set.
+ */
+
+#ifndef SWITCH_SIM_STATS_SHARD_H
+#define SWITCH_SIM_STATS_SHARD_H
+
+#include "types.h"
+#include "error_codes.h"
+
+/** Counter sets that may exist at once */
+#define STATS_SHARD_MAX_SETS 16
+
+/**
+ * @brief Counter set; the fields are private to stats_shard.c
+ */
+typedef struct stats_shard_set {
+    uint32_t id;                        /**< Slot in the per-thread shard table */
+    uint32_t generation;                /**< Never reused, tells a stale thread slot apart */
+    size_t words;                       /**< Counters in a shard */
+    struct stats_shard *shards;         /**< Every shard of the set */
+    struct stats_shard *free_shards;    /**< Shards of exited threads */
+    uint64_t *baseline;                 /**< Totals at the last clear, by counter */
+    uint64_t *spill;                    /**< Shared shard for threads that could not get one */
+} stats_shard_set_t;
+
+/**
+ * @brief Shard of the calling thread in one set
+ */
+typedef struct {
+    uint32_t generation;                /**< Generation of the set the shard belongs to */
+    uint64_t *words;
+} stats_shard_slot_t;
+
+/** Shards of the calling thread, by set ID */
+extern __thread stats_shard_slot_t g_stats_shard_slots[STATS_SHARD_MAX_SETS];
+
+/**
+ * @brief Create a counter set
+ *
+ * @param words Counters per shard
+ * @param[out] set New set
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER,
+ *         STATUS_RESOURCE_EXHAUSTED if STATS_SHARD_MAX_SETS sets exist,
+ *         STATUS_NO_MEMORY
+ */
+status_t stats_shard_create(size_t words, stats_shard_set_t **set);
+
+/**
+ * @brief Free a counter set and all its shards
+ *
+ * No thread may count in the set any more.
+ *
+ * @param set Set, may be NULL
+ */
+void stats_shard_destroy(stats_shard_set_t *set);
+
+/**
+ * @brief Give the calling thread a shard; slow path of stats_shard_local()
+ *
+ * @param set Set
+ * @return Counters of the new shard; the shared spill shard if none could
+ *         be allocated, whose counts may then be lost to races
+ */
+uint64_t *stats_shard_attach(stats_shard_set_t *set);
+
+/**
+ * @brief Get the counters of the calling thread
+ *
+ * @param set Set
+ * @return Counters, indexed like the set
+ */
+static inline uint64_t *stats_shard_local(stats_shard_set_t *set) {
+    stats_shard_slot_t *slot = &g_stats_shard_slots[set->id];
+
+    if (__builtin_expect(slot->generation == set->generation, 1)) {
+        return slot->words;
+    }
+    return stats_shard_attach(set);
+}
+
+/**
+ * @brief Add to a counter of the calling thread's shard
+ *
+ * @param counter Counter in a shard from stats_shard_local()
+ * @param value Amount
+ */
+static inline void stats_shard_add(uint64_t *counter, uint64_t value) {
+    __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Fold a range of counters over all shards
+ *
+ * @param set Set
+ * @param first First counter
+ * @param count Number of counters
+ * @param[out] out Totals since the last clear, count of them
+ */
+void stats_shard_fold(stats_shard_set_t *set, size_t first, size_t count, uint64_t *out);
+
+/**
+ * @brief Clear a range of counters
+ *
+ * @param set Set
+ * @param first First counter
+ * @param count Number of counters
+ */
+void stats_shard_clear(stats_shard_set_t *set, size_t first, size_t count);
+
+#endif /* SWITCH_SIM_STATS_SHARD_H */
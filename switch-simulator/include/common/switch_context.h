@@ -0,0 +1,46 @@
+/**
+ * @file switch_context.h
+ * @brief Switch instance a thread works on
+ *
+ * One process can model several switches. Modules that keep per-switch
+ * state (the MAC table and the VLAN module) hold one copy of it per
+ * instance and use the copy of the instance the calling thread is bound
+ * to. Every thread starts bound to SWITCH_INSTANCE_DEFAULT, the process's
+ * own switch, so code that never binds keeps single-switch behaviour.
+ *
+ * An instance's state is created by the module's init function called
+ * while bound to it, and released by its cleanup function; no other call
+ * may be made for an instance before its init.
+ */
+
+#ifndef SWITCH_SIM_SWITCH_CONTEXT_H
+#define SWITCH_SIM_SWITCH_CONTEXT_H
+
+#include "types.h"
+#include "error_codes.h"
+#include "config.h"
+
+/** Instance of the process's own switch */
+#define SWITCH_INSTANCE_DEFAULT 0
+
+/** Instance of the calling thread; use the functions below */
+extern __thread uint32_t t_switch_instance;
+
+/**
+ * @brief Instance the calling thread is bound to
+ *
+ * @return Instance number, below CONFIG_MAX_SWITCH_INSTANCES
+ */
+static inline uint32_t switch_context_current(void) {
+    return t_switch_instance;
+}
+
+/**
+ * @brief Bind the calling thread to an instance
+ *
+ * @param instance Instance number
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER if out of range
+ */
+status_t switch_context_bind(uint32_t instance);
+
+#endif /* SWITCH_SIM_SWITCH_CONTEXT_H */
@@ -0,0 +1,96 @@
+/**
+ * @file table_cursor.h
+ * @brief Resume tokens for reading large tables a page at a time
+ *
+ * The page reads of the MAC table, the ARP and ND caches, the routing
+ * table and the VLAN table take a cursor, fill the caller's array with
+ * the next entries and move the cursor on; the lock, if any, is held for
+ * one page only. Start with TABLE_CURSOR_START and read until the cursor
+ * comes back as TABLE_CURSOR_END. Cursors are plain values, so a caller
+ * may keep one between calls for as long as it likes.
+ *
+ * Hash tables are walked bucket by bucket and a page ends between
+ * buckets. Tables that double their buckets go in reverse binary order
+ * over the bucket bits: a bucket the walk has passed splits into buckets
+ * it has passed too, so a doubling between pages neither repeats nor
+ * skips entries, and every entry present for the whole walk is returned
+ * once. A table that splits one bucket at a time takes a bucket
+ * and the one it split into as one step, in the same order. Entries
+ * added or removed meanwhile may or may not be seen.
+ *
+ * A bucket with more entries than a page holds spans pages; the cursor
+ * then counts the entries of the bucket already returned, and starts
+ * over with the bucket if the table was resized in between.
+ */
+
+#ifndef SWITCH_SIM_TABLE_CURSOR_H
+#define SWITCH_SIM_TABLE_CURSOR_H
+
+#include <stdint.h>
+
+/**
+ * @brief Cursor: bucket in bits 0-31, log2 of the buckets in 32-39, and
+ *        entries of the bucket already returned in 40-63
+ */
+typedef uint64_t table_cursor_t;
+
+#define TABLE_CURSOR_START      0ull
+#define TABLE_CURSOR_END        UINT64_MAX
+
+/** Entries of one bucket a cursor can count */
+#define TABLE_CURSOR_SKIP_MAX   0xFFFFFFu
+
+/**
+ * @brief Cursor at entry skip of a bucket
+ *
+ * @param bucket Bucket, or bucket bits of a reverse binary walk
+ * @param mask Buckets - 1 of the table, a power of two minus one
+ * @param skip Entries of the bucket already returned
+ */
+static inline table_cursor_t table_cursor_make(uint32_t bucket, uint32_t mask, uint32_t skip) {
+    return (table_cursor_t)(skip > TABLE_CURSOR_SKIP_MAX ? TABLE_CURSOR_SKIP_MAX : skip) << 40 |
+           (table_cursor_t)__builtin_popcount(mask) << 32 | bucket;
+}
+
+static inline uint32_t table_cursor_bucket(table_cursor_t cursor) {
+    return (uint32_t)cursor;
+}
+
+/**
+ * @brief Entries of the cursor's bucket to pass over
+ *
+ * @param cursor Cursor
+ * @param mask Buckets - 1 of the table now
+ * @return The count kept in the cursor, or 0 if the table was resized
+ *         since it was made
+ */
+static inline uint32_t table_cursor_skip(table_cursor_t cursor, uint32_t mask) {
+    if ((uint32_t)(cursor >> 32 & 0xFF) != (uint32_t)__builtin_popcount(mask)) {
+        return 0;
+    }
+    return (uint32_t)(cursor >> 40);
+}
+
+static inline uint32_t table_cursor_reverse(uint32_t v) {
+    v = (v >> 1 & 0x55555555u) | (v & 0x55555555u) << 1;
+    v = (v >> 2 & 0x33333333u) | (v & 0x33333333u) << 2;
+    v = (v >> 4 & 0x0F0F0F0Fu) | (v & 0x0F0F0F0Fu) << 4;
+    v = (v >> 8 & 0x00FF00FFu) | (v & 0x00FF00FFu) << 8;
+    return v >> 16 | v << 16;
+}
+
+/**
+ * @brief Next bucket of a reverse binary walk
+ *
+ * Increments the bits of mask from the highest down.
+ *
+ * @param v Bucket bits
+ * @param mask Buckets - 1 of the table
+ * @return Next bucket bits, 0 once every bucket was visited
+ */
+static inline uint32_t table_cursor_next(uint32_t v, uint32_t mask) {
+    v |= ~mask;
+    return table_cursor_reverse(table_cursor_reverse(v) + 1);
+}
+
+#endif /* SWITCH_SIM_TABLE_CURSOR_H */
@@ -1,19 +1,68 @@
 /**
  * @file threading.h
  * @brief Threading type definitions and synchronization primitives for switch simulator
+ *
+ * Spinlocks are test-and-test-and-set locks: a waiter spins on plain loads
+ * of the lock word, which stays in its cache while the lock is held, and
+ * only retries the atomic exchange once the word reads free. Between looks
+ * it backs off exponentially, up to CONFIG_SPINLOCK_BACKOFF_MAX pauses, so
+ * a crowd of waiters does not hammer the line the holder must write to
+ * release.
+ *
+ * Built with CONFIG_SPINLOCK_STATS, every lock counts its acquisitions,
+ * and a lock named with spinlock_set_class() also times its waits and
+ * holds into the counters of its class (lock_stat.h).
+ *
+ * Seqlocks (seqlock.h), rings (ring.h) and RCU (rcu.h) build on the
+ * cpu_relax() hint defined here.
  */
 
 #ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_COMMON_THREADING_H
 #define SDK_ES_SWITCH_SIMULATOR_INCLUDE_COMMON_THREADING_H
 
+#include <stdint.h>
+#include "config.h"
+
+#if CONFIG_SPINLOCK_STATS
+#include "lock_stat.h"
+#endif
 
 /**
  * @brief Spinlock type for thread synchronization
  */
 typedef struct {
     volatile int lock;  /**< Lock variable for atomic operations */
+#if CONFIG_SPINLOCK_STATS
+    uint64_t acquisitions;  /**< Times taken */
+    uint64_t contended;     /**< Times taken after waiting */
+    uint64_t spins;         /**< Pauses spent waiting */
+    struct lock_stat_class *stat_class; /**< Class charged, NULL for none */
+    uint64_t acquired_ns;   /**< When the holder took a classed lock */
+#endif
 } spinlock_t;
 
+/**
+ * @brief Spinlock counters
+ */
+typedef struct {
+    uint64_t acquisitions;
+    uint64_t contended;
+    uint64_t spins;
+} spinlock_stats_t;
+
+/**
+ * @brief Tell the CPU the caller is spinning
+ */
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ volatile("pause" ::: "memory");
+#elif defined(__arm__) || defined(__aarch64__)
+    __asm__ volatile("yield" ::: "memory");
+#else
+    __asm__ volatile("" ::: "memory");
+#endif
+}
+
 /**
  * @brief Initialize a spinlock
  *
@@ -21,6 +70,79 @@ typedef struct {
  */
 static inline void spinlock_init(spinlock_t *lock) {
     lock->lock = 0;
+#if CONFIG_SPINLOCK_STATS
+    lock->acquisitions = 0;
+    lock->contended = 0;
+    lock->spins = 0;
+    lock->stat_class = NULL;
+#endif
+}
+
+/**
+ * @brief Charge a spinlock to a lock class from now on
+ *
+ * Call after spinlock_init() and before the lock is shared. A no-op
+ * unless built with CONFIG_SPINLOCK_STATS.
+ *
+ * @param lock Spinlock
+ * @param name Class name, see lock_stat_class()
+ */
+static inline void spinlock_set_class(spinlock_t *lock, const char *name) {
+#if CONFIG_SPINLOCK_STATS
+    lock->stat_class = lock_stat_class(name);
+#else
+    (void)lock;
+    (void)name;
+#endif
+}
+
+#if CONFIG_SPINLOCK_STATS
+/**
+ * @brief Count an acquisition; the caller now holds the lock
+ */
+static inline void spinlock_account_acquire(spinlock_t *lock, uint64_t spins, uint64_t wait_start) {
+    lock->acquisitions++;
+    if (spins) {
+        lock->contended++;
+        lock->spins += spins;
+    }
+    if (lock->stat_class) {
+        lock->acquired_ns = lock_stat_now();
+        lock_stat_record_acquire(lock->stat_class, spins, spins ? lock->acquired_ns - wait_start : 0);
+    }
+}
+#endif
+
+/**
+ * @brief Wait for a held spinlock and take it
+ *
+ * @param lock Pointer to spinlock to acquire
+ */
+static inline void spinlock_acquire_contended(spinlock_t *lock) {
+    uint32_t backoff = 1;
+    uint64_t spins = 0;
+#if CONFIG_SPINLOCK_STATS
+    uint64_t wait_start = lock->stat_class ? lock_stat_now() : 0;
+#endif
+
+    do {
+        while (__atomic_load_n(&lock->lock, __ATOMIC_RELAXED)) {
+            for (uint32_t i = 0; i < backoff; i++) {
+                cpu_relax();
+            }
+            spins += backoff;
+            if (backoff < CONFIG_SPINLOCK_BACKOFF_MAX) {
+                backoff <<= 1;
+            }
+        }
+    } while (__sync_lock_test_and_set(&lock->lock, 1));
+
+#if CONFIG_SPINLOCK_STATS
+    // A lock freed between the failed exchange and the first look counts one pause
+    spinlock_account_acquire(lock, spins ? spins : 1, wait_start);
+#else
+    (void)spins;
+#endif
 }
 
 /**
@@ -29,33 +151,13 @@ static inline void spinlock_init(spinlock_t *lock) {
  * @param lock Pointer to spinlock to acquire
  */
 static inline void spinlock_acquire(spinlock_t *lock) {
-    while (__sync_lock_test_and_set(&lock->lock, 1)) {
-        // Spin until acquired
-        // In a real implementation, we might want to add a short delay
-        // or CPU yield instruction here
-
-        // Варианты реализации задержки:
-        
-        // 1. CPU yield - для х86/х86_64
-        #if defined(__x86_64__) || defined(__i386__)
-            __asm__ volatile("pause" ::: "memory");
-        #elif defined(__arm__) || defined(__aarch64__)
-            // Для ARM архитектуры
-            __asm__ volatile("yield" ::: "memory");
-        #endif
-
-        // 2. Короткий цикл для создания задержки
-        for (volatile int i = 0; i < 10; i++) { }
-
-        // 3. Счетчик попыток с экспоненциальной задержкой
-        // static int backoff = 1;
-        // if (backoff < 1024) backoff *= 2;
-        // for (volatile int i = 0; i < backoff; i++) { }
-
+    if (__builtin_expect(__sync_lock_test_and_set(&lock->lock, 1), 0)) {
+        spinlock_acquire_contended(lock);
+        return;
     }
-
-    // Сброс счетчика задержки при успешном получении блокировки
-    // backoff = 1;
+#if CONFIG_SPINLOCK_STATS
+    spinlock_account_acquire(lock, 0, 0);
+#endif
 }
 
 /**
@@ -64,6 +166,11 @@ static inline void spinlock_acquire(spinlock_t *lock) {
  * @param lock Pointer to spinlock to release
  */
 static inline void spinlock_release(spinlock_t *lock) {
+#if CONFIG_SPINLOCK_STATS
+    if (lock->stat_class) {
+        lock_stat_record_hold(lock->stat_class, lock_stat_now() - lock->acquired_ns);
+    }
+#endif
     __sync_lock_release(&lock->lock);
 }
 
@@ -74,7 +181,35 @@ static inline void spinlock_release(spinlock_t *lock) {
  * @return int 0 if lock was acquired, non-zero if it was already locked
  */
 static inline int spinlock_try_acquire(spinlock_t *lock) {
-    return __sync_lock_test_and_set(&lock->lock, 1);
+    if (__atomic_load_n(&lock->lock, __ATOMIC_RELAXED) || __sync_lock_test_and_set(&lock->lock, 1)) {
+        return 1;
+    }
+#if CONFIG_SPINLOCK_STATS
+    spinlock_account_acquire(lock, 0, 0);
+#endif
+    return 0;
+}
+
+/**
+ * @brief Get the counters of a spinlock
+ *
+ * Exact when called with the lock held, approximate otherwise. All zero
+ * unless built with CONFIG_SPINLOCK_STATS.
+ *
+ * @param lock Spinlock
+ * @param[out] stats Counters
+ */
+static inline void spinlock_get_stats(const spinlock_t *lock, spinlock_stats_t *stats) {
+#if CONFIG_SPINLOCK_STATS
+    stats->acquisitions = __atomic_load_n(&lock->acquisitions, __ATOMIC_RELAXED);
+    stats->contended = __atomic_load_n(&lock->contended, __ATOMIC_RELAXED);
+    stats->spins = __atomic_load_n(&lock->spins, __ATOMIC_RELAXED);
+#else
+    (void)lock;
+    stats->acquisitions = 0;
+    stats->contended = 0;
+    stats->spins = 0;
+#endif
 }
 
 #endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_COMMON_THREADING_H */
@@ -0,0 +1,225 @@
+/**
+ * @file trace.h
+ * @brief Binary tracing of high-rate control plane events
+ *
+ * Tracepoints record fixed-size binary records, timestamped with the
+ * cycle counter, into a ring of the calling thread: no lock, no
+ * formatting and no allocation after a thread's first record. Rings keep
+ * the newest CONFIG_TRACE_RING_SIZE records and overwrite the oldest.
+ *
+ * Every event is switched on and off on its own. A tracepoint of an event
+ * that is off costs one relaxed load and a predicted branch, and its
+ * arguments are not evaluated; without CONFIG_ENABLE_TRACING tracepoints
+ * are not compiled in.
+ *
+ * trace_dump() writes every ring to a file that
+ * tools/scripts/trace_decode.py turns into text or into the Chrome trace
+ * event format that Perfetto and chrome://tracing open.
+ */
+
+#ifndef SWITCH_SIM_TRACE_H
+#define SWITCH_SIM_TRACE_H
+
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "types.h"
+#include "error_codes.h"
+#include "config.h"
+
+/** File magic, "SWTRACE" and a format version */
+#define TRACE_FILE_MAGIC        "SWTRACE1"
+
+/** Longest event name in the file header, terminator included */
+#define TRACE_NAME_MAX          24
+
+/**
+ * @brief Traced events
+ *
+ * The arguments of each event are listed as a0, a1, a2. MAC addresses
+ * are packed with trace_mac_arg(); addresses are their bytes as stored,
+ * an IPv4 address in the low four bytes of a1, an IPv6 address over a1
+ * and a2.
+ */
+typedef enum {
+    TRACE_MAC_LEARN = 0,        /**< a0 port, a1 MAC and VLAN, a2 1 if static */
+    TRACE_MAC_MOVE,             /**< a0 new port, a1 MAC and VLAN, a2 old port */
+    TRACE_MAC_REMOVE,           /**< a0 port, a1 MAC and VLAN, a2 1 if aged out */
+    TRACE_ROUTE_ADD,            /**< a0 VRF << 16 | IP version << 8 | prefix length, a1 a2 prefix */
+    TRACE_ROUTE_REMOVE,         /**< a0 as TRACE_ROUTE_ADD, a1 a2 prefix */
+    TRACE_ARP_STATE,            /**< a0 port << 16 | IP version << 8 | new state, a1 a2 address */
+    TRACE_STP_ROLE,             /**< a0 port, a1 old role, a2 new role */
+    TRACE_STP_STATE,            /**< a0 port, a1 old state, a2 new state */
+    TRACE_EVENT_COUNT
+} trace_event_t;
+
+/** Mask of every event */
+#define TRACE_ALL_EVENTS        ((1ULL << TRACE_EVENT_COUNT) - 1)
+
+/**
+ * @brief One trace record, as kept in the rings and written to files
+ */
+typedef struct {
+    uint64_t tsc;               /**< Cycle counter, see trace_now() */
+    uint16_t event;             /**< trace_event_t */
+    uint16_t ring;              /**< Ring of the recording thread */
+    uint32_t a0;
+    uint64_t a1;
+    uint64_t a2;
+} trace_record_t;
+
+/**
+ * @brief Header of a trace file
+ *
+ * Followed by event_count names of TRACE_NAME_MAX bytes, then
+ * record_count records, ordered by ring and by time within a ring.
+ */
+typedef struct {
+    char magic[8];              /**< TRACE_FILE_MAGIC, unterminated */
+    uint32_t record_size;       /**< sizeof(trace_record_t) */
+    uint32_t event_count;       /**< Names following the header */
+    uint64_t record_count;
+    uint64_t start_tsc;         /**< Cycle counter at trace_init() */
+    uint64_t start_ns;          /**< CLOCK_REALTIME at trace_init() */
+    double ticks_per_ns;        /**< Cycle counter rate, measured up to the dump */
+} trace_file_header_t;
+
+/** Events switched on, one bit per trace_event_t */
+extern uint64_t g_trace_events;
+
+/**
+ * @brief Read the cycle counter
+ *
+ * The TSC where there is one, monotonic nanoseconds elsewhere.
+ */
+static inline uint64_t trace_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Pack a MAC address and VLAN into one argument
+ *
+ * The MAC bytes in order from the most significant of the low 48 bits,
+ * the VLAN above them.
+ */
+static inline uint64_t trace_mac_arg(const mac_addr_t *mac, vlan_id_t vlan) {
+    uint64_t value = (uint64_t)vlan;
+
+    for (int i = 0; i < MAC_ADDR_LEN; i++) {
+        value = (value << 8) | mac->addr[i];
+    }
+    return value;
+}
+
+/**
+ * @brief Check if an event is switched on
+ */
+static inline bool trace_enabled(trace_event_t event) {
+    return __builtin_expect((__atomic_load_n(&g_trace_events, __ATOMIC_RELAXED) >> event) & 1, 0);
+}
+
+/**
+ * @brief Record an event into the ring of the calling thread
+ *
+ * Use TRACE_POINT(), which checks the event first.
+ */
+void trace_record(trace_event_t event, uint32_t a0, uint64_t a1, uint64_t a2);
+
+#if CONFIG_ENABLE_TRACING
+/**
+ * @brief Tracepoint; the arguments are evaluated only if the event is on
+ */
+#define TRACE_POINT(event, a0, a1, a2)                                          \
+    do {                                                                        \
+        if (trace_enabled(event)) {                                             \
+            trace_record((event), (uint32_t)(a0), (uint64_t)(a1), (uint64_t)(a2)); \
+        }                                                                       \
+    } while (0)
+#else
+/* The arguments stay referenced, so variables kept for them do not go unused */
+#define TRACE_POINT(event, a0, a1, a2)                                          \
+    do {                                                                        \
+        if (0) {                                                                \
+            (void)(event); (void)(a0); (void)(a1); (void)(a2);                  \
+        }                                                                       \
+    } while (0)
+#endif
+
+/**
+ * @brief Note the clock calibration point; called once at startup
+ *
+ * @return STATUS_SUCCESS
+ */
+status_t trace_init(void);
+
+/**
+ * @brief Switch events on
+ *
+ * @param events Mask of events, bit n for trace_event_t n
+ */
+void trace_enable(uint64_t events);
+
+/**
+ * @brief Switch events off
+ *
+ * @param events Mask of events, bit n for trace_event_t n
+ */
+void trace_disable(uint64_t events);
+
+/**
+ * @brief Mask of the events switched on
+ */
+uint64_t trace_get_events(void);
+
+/**
+ * @brief Name of an event, as in trace files and the CLI
+ */
+const char *trace_event_name(trace_event_t event);
+
+/**
+ * @brief Look an event up by name
+ *
+ * @param name Event name
+ * @param[out] event Event
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER or STATUS_NOT_FOUND
+ */
+status_t trace_event_from_name(const char *name, trace_event_t *event);
+
+/**
+ * @brief Records in all rings and records overwritten since the last clear
+ *
+ * @param[out] recorded Records kept, may be NULL
+ * @param[out] lost Records overwritten, may be NULL
+ */
+void trace_get_counts(uint64_t *recorded, uint64_t *lost);
+
+/**
+ * @brief Empty every ring
+ *
+ * Records made while the rings are cleared may survive.
+ */
+void trace_clear(void);
+
+/**
+ * @brief Write every ring to a trace file
+ *
+ * Tracing goes on meanwhile; records overwritten while a ring is copied
+ * are left out.
+ *
+ * @param path File to create or replace
+ * @param[out] written Records written, may be NULL
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY or STATUS_FAILURE
+ */
+status_t trace_dump(const char *path, uint64_t *written);
+
+#endif /* SWITCH_SIM_TRACE_H */
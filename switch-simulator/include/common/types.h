@@ -60,6 +60,7 @@ typedef enum
     STATUS_INSUFFICIENT_RESOURCES = -21,   /**< Insufficient resources */
     STATUS_ERROR_INVALID_PARAM  = -22,         /**< Invalid param */
     STATUS_ERROR = -23,
+    STATUS_NOT_EXECUTED = -24,             /**< Not tried: an earlier step of a bulk operation failed */
     STATUS_FAILURE = -99                  /**< Generic failure */
 } status_t;
 
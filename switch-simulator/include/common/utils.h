@@ -14,6 +14,10 @@
 #include "types.h"
 #include "error_codes.h"
 
+#define MAC_STRING_SIZE     18  /**< "xx:xx:xx:xx:xx:xx" and terminator */
+#define IPV4_STRING_SIZE    16  /**< "255.255.255.255" and terminator */
+#define IPV6_STRING_SIZE    40  /**< Eight groups of four digits and terminator */
+
 /**
  * @brief Convert MAC address to string representation
  * 
@@ -26,7 +30,7 @@ char* mac_to_string(const mac_addr_t *mac, char *buffer);
 /**
  * @brief Convert string representation to MAC address
  * 
- * @param str String in format "xx:xx:xx:xx:xx:xx"
+ * @param str String in format "xx:xx:xx:xx:xx:xx", one or two hex digits per octet
  * @param mac Output MAC address
  * @return status_t STATUS_SUCCESS if successful
  */
@@ -35,7 +39,7 @@ status_t string_to_mac(const char *str, mac_addr_t *mac);
 /**
  * @brief Convert IPv4 address to string representation
  * 
- * @param ipv4 IPv4 address in network byte order
+ * @param ipv4 IPv4 address, first octet in the most significant byte
  * @param buffer Output buffer (should be at least 16 bytes)
  * @return char* Pointer to buffer containing IP string
  */
@@ -53,6 +57,9 @@ status_t string_to_ipv4(const char *str, ipv4_addr_t *ipv4);
 /**
  * @brief Convert IPv6 address to string representation
  * 
+ * Every group is written with four digits and none is compressed, so
+ * the string always has the same length.
+ *
  * @param ipv6 IPv6 address
  * @param buffer Output buffer (should be at least 40 bytes)
  * @return char* Pointer to buffer containing IPv6 string
@@ -62,12 +69,63 @@ char* ipv6_to_string(const ipv6_addr_t *ipv6, char *buffer);
 /**
  * @brief Convert string representation to IPv6 address
  * 
- * @param str String in IPv6 format
+ * @param str String in IPv6 format: groups of one to four hex digits, with
+ *            at most one "::" for a run of zero groups
  * @param ipv6 Output IPv6 address
  * @return status_t STATUS_SUCCESS if successful
  */
 status_t string_to_ipv6(const char *str, ipv6_addr_t *ipv6);
 
+/**
+ * @brief Convert an array of MAC addresses to one string
+ *
+ * Writes each address followed by separator, and a terminator after the
+ * last. Stops early when the buffer has no room for one more address.
+ *
+ * @param macs MAC addresses
+ * @param count Number of addresses
+ * @param separator Character written after each address, e.g. '\n'
+ * @param buffer Output buffer
+ * @param size Size of buffer
+ * @param[out] length Characters written, without the terminator; may be NULL
+ * @return size_t Number of addresses converted
+ */
+size_t mac_to_string_bulk(const mac_addr_t *macs, size_t count, char separator,
+                          char *buffer, size_t size, size_t *length);
+
+/**
+ * @brief Convert an array of IPv4 addresses to one string
+ *
+ * As mac_to_string_bulk(). An address is only written while the buffer
+ * has room for the longest one.
+ *
+ * @param addrs IPv4 addresses
+ * @param count Number of addresses
+ * @param separator Character written after each address
+ * @param buffer Output buffer
+ * @param size Size of buffer
+ * @param[out] length Characters written, without the terminator; may be NULL
+ * @return size_t Number of addresses converted
+ */
+size_t ipv4_to_string_bulk(const ipv4_addr_t *addrs, size_t count, char separator,
+                           char *buffer, size_t size, size_t *length);
+
+/**
+ * @brief Convert an array of IPv6 addresses to one string
+ *
+ * As mac_to_string_bulk(), in the format of ipv6_to_string().
+ *
+ * @param addrs IPv6 addresses
+ * @param count Number of addresses
+ * @param separator Character written after each address
+ * @param buffer Output buffer
+ * @param size Size of buffer
+ * @param[out] length Characters written, without the terminator; may be NULL
+ * @return size_t Number of addresses converted
+ */
+size_t ipv6_to_string_bulk(const ipv6_addr_t *addrs, size_t count, char separator,
+                           char *buffer, size_t size, size_t *length);
+
 
 
 /**
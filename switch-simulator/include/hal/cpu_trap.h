@@ -0,0 +1,190 @@
+/**
+ * @file cpu_trap.h
+ * @brief CPU port trap ring in shared memory for external consumers
+ *
+ * Packets trapped to the CPU port can be published in a POSIX
+ * shared-memory ring (shm_open(), so on Linux /dev/shm/<name>) that
+ * processes outside the simulator, a capture tool or a protocol daemon,
+ * map and read in place. The forwarding workers never touch the ring: they
+ * hand trapped packets to the punt path as shared references (l3/punt.h),
+ * and the punt thread copies each one, up to the ring's snap length, into
+ * the next free record. A consumer that falls behind costs the simulator
+ * nothing but the records it misses, which are counted in the header.
+ *
+ * Layout, little-endian as on the host, offsets from the start of the
+ * segment:
+ *
+ *   0                cpu_trap_header_t
+ *   slots_offset     slot_count records of slot_size bytes, each a
+ *                    cpu_trap_record_t followed by cap_len bytes of frame
+ *
+ * The ring is single producer, single consumer. head counts the records
+ * ever written and tail the records ever consumed; record n is in slot
+ * n & (slot_count - 1). The simulator writes records and then stores head
+ * with release order; the consumer loads head with acquire order, reads
+ * any number of records between tail and head where they lie, and then
+ * stores tail with release order to give their slots back. The inline
+ * helpers at the end of this file do this for C consumers. A different
+ * major version changes the layout and must be refused.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_HAL_CPU_TRAP_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_HAL_CPU_TRAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "packet.h"
+
+/** "SWTR" read as a little-endian uint32_t */
+#define CPU_TRAP_MAGIC              0x52545753u
+#define CPU_TRAP_VERSION_MAJOR      1
+#define CPU_TRAP_VERSION_MINOR      0
+
+/** Segment name used when none is given */
+#define CPU_TRAP_DEFAULT_NAME       "/switch_sim_cpu"
+
+#define CPU_TRAP_MAX_REASONS        16      /**< Reason counters in the header */
+#define CPU_TRAP_FLAG_TRUNCATED     0x1     /**< Frame longer than the snap length */
+
+/**
+ * @brief Why a packet went to the CPU
+ */
+typedef enum {
+    CPU_TRAP_REASON_ARP = 0,        /**< ARP frame */
+    CPU_TRAP_REASON_ICMP,           /**< ICMP or ICMPv6 to the switch */
+    CPU_TRAP_REASON_IGMP,           /**< IGMP */
+    CPU_TRAP_REASON_OSPF,           /**< OSPF */
+    CPU_TRAP_REASON_RIP,            /**< RIP or RIPng */
+    CPU_TRAP_REASON_LOCAL,          /**< Other TCP or UDP traffic to the switch */
+    CPU_TRAP_REASON_COUNT
+} cpu_trap_reason_t;
+
+/**
+ * @brief Segment header, at offset 0
+ */
+typedef struct {
+    uint32_t magic;             /**< CPU_TRAP_MAGIC */
+    uint16_t version_major;     /**< CPU_TRAP_VERSION_MAJOR */
+    uint16_t version_minor;     /**< CPU_TRAP_VERSION_MINOR */
+    uint32_t header_size;       /**< sizeof(cpu_trap_header_t) */
+    uint32_t writer_pid;        /**< Process that publishes the ring */
+    uint64_t total_size;        /**< Size of the segment in bytes */
+    uint32_t slot_count;        /**< Records in the ring, a power of two */
+    uint32_t slot_size;         /**< Bytes from one record to the next */
+    uint32_t snaplen;           /**< Frame bytes a record holds at most */
+    uint32_t slots_offset;      /**< Offset of the first record */
+    uint64_t trapped[CPU_TRAP_MAX_REASONS]; /**< Records written, by cpu_trap_reason_t */
+    uint64_t ring_full;         /**< Packets not written because the ring was full */
+    uint64_t truncated;         /**< Records cut to the snap length */
+
+    /** Records ever written; only the simulator stores it */
+    uint64_t head __attribute__((aligned(64)));
+    /** Records ever consumed; only the consumer stores it */
+    uint64_t tail __attribute__((aligned(64)));
+} __attribute__((aligned(64))) cpu_trap_header_t;
+
+/**
+ * @brief Record of one trapped packet
+ */
+typedef struct {
+    uint64_t timestamp_ns;      /**< CLOCK_REALTIME when it was written */
+    uint32_t orig_len;          /**< Length of the frame */
+    uint32_t cap_len;           /**< Bytes of it in data */
+    uint16_t port;              /**< Ingress port */
+    uint16_t vlan;              /**< Classified VLAN */
+    uint16_t reason;            /**< cpu_trap_reason_t */
+    uint16_t flags;             /**< CPU_TRAP_FLAG_* */
+    uint8_t data[];             /**< Frame from its Ethernet header */
+} cpu_trap_record_t;
+
+/**
+ * @brief Ring counters
+ */
+typedef struct {
+    uint64_t trapped[CPU_TRAP_REASON_COUNT];
+    uint64_t ring_full;
+    uint64_t truncated;
+    uint32_t depth;             /**< Records not consumed yet */
+} cpu_trap_stats_t;
+
+/**
+ * @brief Create and map the trap ring
+ *
+ * An existing segment of the same name is replaced. Packets are written
+ * from then on, whether or not a consumer has mapped the ring.
+ *
+ * @param name Segment name as for shm_open(), NULL for CPU_TRAP_DEFAULT_NAME
+ * @param slot_count Records, a power of two, 0 for CONFIG_CPU_TRAP_RING_SIZE
+ * @param snaplen Frame bytes kept per record, 0 for CONFIG_CPU_TRAP_SNAPLEN
+ * @return STATUS_SUCCESS, STATUS_ALREADY_INITIALIZED if a ring is open,
+ *         STATUS_INVALID_PARAMETER, or STATUS_FAILURE if the segment could
+ *         not be created
+ */
+status_t cpu_trap_open(const char *name, uint32_t slot_count, uint32_t snaplen);
+
+/**
+ * @brief Stop writing, then unmap and unlink the ring
+ *
+ * Consumers that still have it mapped keep what they mapped.
+ */
+void cpu_trap_close(void);
+
+/**
+ * @brief Whether a ring is open, for producers to skip the call cheaply
+ */
+bool cpu_trap_enabled(void);
+
+/**
+ * @brief Write trapped packets to the ring
+ *
+ * Calls are serialized; the punt thread is the usual caller. The packets
+ * stay with the caller.
+ *
+ * @param pkts Packets
+ * @param count Number of packets
+ * @param reason Reason recorded for all of them
+ * @return Records written; packets that found the ring full are counted
+ */
+uint32_t cpu_trap_submit(packet_buffer_t *const *pkts, uint32_t count, cpu_trap_reason_t reason);
+
+/**
+ * @brief Get the ring counters
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS, STATUS_NOT_INITIALIZED if no ring is open
+ */
+status_t cpu_trap_get_stats(cpu_trap_stats_t *stats);
+
+/**
+ * @brief Consumer: records ready to read
+ *
+ * @param hdr Mapped segment
+ * @param[out] pos Number of the first ready record
+ * @return Records ready, from *pos on
+ */
+static inline uint32_t cpu_trap_peek(const cpu_trap_header_t *hdr, uint64_t *pos) {
+    uint64_t tail = __atomic_load_n(&hdr->tail, __ATOMIC_RELAXED);
+    uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+
+    *pos = tail;
+    return (uint32_t)(head - tail);
+}
+
+/**
+ * @brief Consumer: record number pos, read in place
+ */
+static inline const cpu_trap_record_t *cpu_trap_record(const cpu_trap_header_t *hdr, uint64_t pos) {
+    return (const cpu_trap_record_t *)((const uint8_t *)hdr + hdr->slots_offset +
+                                       (size_t)(pos & (hdr->slot_count - 1)) * hdr->slot_size);
+}
+
+/**
+ * @brief Consumer: give back every record before pos
+ */
+static inline void cpu_trap_release(cpu_trap_header_t *hdr, uint64_t pos) {
+    __atomic_store_n(&hdr->tail, pos, __ATOMIC_RELEASE);
+}
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_HAL_CPU_TRAP_H */
@@ -62,6 +62,8 @@ typedef struct driver_ops {
     status_t (*get_stats)(driver_t *drv, void *stats);
     /** Optional: Set driver-specific configuration */
     status_t (*set_config)(driver_t *drv, const void *config);
+    /** Optional: Transmit a burst; returns how many packets were sent (a prefix) */
+    uint16_t (*transmit_burst)(driver_t *drv, packet_t **pkts, uint16_t n);
 } driver_ops_t;
 
 /**
@@ -97,9 +99,15 @@ typedef enum {
     DRIVER_FLAG_DMA_CAPABLE  = (1 << 3), /**< DMA transfer support         */
     DRIVER_FLAG_IRQ_CAPABLE  = (1 << 4), /**< Interrupt handling support   */
     DRIVER_FLAG_LOOPBACK     = (1 << 5), /**< Loopback mode support        */
-    DRIVER_FLAG_FLOW_CONTROL = (1 << 6)  /**< Flow control support         */
+    DRIVER_FLAG_FLOW_CONTROL = (1 << 6), /**< Flow control support         */
+    DRIVER_FLAG_TX_CSUM      = (1 << 7), /**< Fills in IPv4 and TCP/UDP checksums on TX */
+    DRIVER_FLAG_TSO          = (1 << 8), /**< Cuts TCP frames into MSS segments on TX  */
+    DRIVER_FLAG_RX_CSUM      = (1 << 9)  /**< Verifies checksums on RX                 */
 } driver_flags_t;
 
+/** Offload capabilities among the driver flags */
+#define DRIVER_FLAGS_OFFLOAD (DRIVER_FLAG_TX_CSUM | DRIVER_FLAG_TSO | DRIVER_FLAG_RX_CSUM)
+
 /* Driver management API via inline wrappers */
 static inline status_t driver_init(driver_handle_t h) {
     return h && h->ops && h->ops->init ? h->ops->init(h) : STATUS_INVALID_PARAMETER;
@@ -107,6 +115,28 @@ static inline status_t driver_init(driver_handle_t h) {
 static inline status_t driver_transmit_packet(driver_handle_t h, packet_t *p) {
     return h && h->ops && h->ops->transmit && p ? h->ops->transmit(h, p) : STATUS_INVALID_PARAMETER;
 }
+/**
+ * @brief Transmit a burst of packets
+ *
+ * Drivers without transmit_burst get one transmit call per packet, up to
+ * the first failure. The packets stay with the caller either way.
+ *
+ * @return Number of packets sent, a prefix of pkts
+ */
+static inline uint16_t driver_transmit_burst(driver_handle_t h, packet_t **pkts, uint16_t n) {
+    if (!h || !h->ops || !pkts) {
+        return 0;
+    }
+    if (h->ops->transmit_burst) {
+        return h->ops->transmit_burst(h, pkts, n);
+    }
+
+    uint16_t sent = 0;
+    while (h->ops->transmit && sent < n && h->ops->transmit(h, pkts[sent]) == STATUS_SUCCESS) {
+        sent++;
+    }
+    return sent;
+}
 static inline status_t driver_shutdown(driver_handle_t h) {
     return h && h->ops && h->ops->shutdown ? h->ops->shutdown(h) : STATUS_INVALID_PARAMETER;
 }
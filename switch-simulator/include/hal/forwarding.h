@@ -0,0 +1,124 @@
+/**
+ * @file forwarding.h
+ * @brief Multi-core forwarding engine for switch simulator
+ *
+ * The forwarding engine runs a pool of worker threads. Each port RX ring
+ * is drained by exactly one worker, which spreads the packets over all
+ * workers by flow hash through per-worker-pair queues. A flow always
+ * lands on the same worker, so per-flow ordering is kept.
+ *
+ * Pinned workers get their memory on their own NUMA node: the queues they
+ * drain, the RX rings of their ports and their staging buffers.
+ *
+ * A worker that finds no work first re-polls at once for idle_spin_polls
+ * rounds, then pauses between rounds for idle_pause_polls more, doubling
+ * the pause up to 64 cpu_relax() hints, and then blocks on an
+ * eventfd that a port RX ring or another worker signals when it queues
+ * packets for it. Few spin and pause rounds suit shared hosts; many, or
+ * no blocking at all, suit latency-sensitive ones, at the cost of a core
+ * per worker. The worker counters report the time spent in each state.
+ */
+
+#ifndef SWITCH_SIM_FORWARDING_H
+#define SWITCH_SIM_FORWARDING_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "packet.h"
+
+/**
+ * @brief Forwarding engine configuration
+ */
+typedef struct {
+    uint32_t num_workers;       /**< Worker threads, 0 = CONFIG_WORKER_THREADS or online CPUs */
+    uint32_t burst_size;        /**< Packets per ring operation, 0 = PACKET_BURST_MAX */
+    bool pin_workers;           /**< Pin worker i to CPU (first_cpu + i) % online CPUs */
+    uint32_t first_cpu;         /**< First CPU used for pinning */
+    const char *cpu_list;       /**< CPUs to pin to instead, in worker order, e.g. "0-7,16-23"; NULL for none */
+    uint32_t idle_spin_polls;   /**< Empty poll rounds spun through before backing off */
+    uint32_t idle_pause_polls;  /**< Further empty rounds with pause backoff before blocking */
+    bool idle_block;            /**< Block when those are used up; false keeps pausing */
+} forwarding_config_t;
+
+/**
+ * @brief Per-worker counters
+ */
+typedef struct {
+    uint64_t rx_packets;        /**< Packets taken from port RX rings */
+    uint64_t dispatched;        /**< Packets handed to other workers */
+    uint64_t processed;         /**< Packets run through the pipeline on this worker */
+    uint64_t dispatch_drops;    /**< Packets dropped because a worker queue was full */
+    uint64_t idle_polls;        /**< Poll rounds that found no work */
+    uint64_t spin_ns;           /**< Time spent spinning on empty rings */
+    uint64_t pause_ns;          /**< Time spent in pause backoff */
+    uint64_t block_ns;          /**< Time spent blocked */
+    uint64_t blocks;            /**< Times the worker blocked */
+    uint64_t wakeups;           /**< Blocks ended by a signal rather than the timeout */
+    uint32_t ports;             /**< Number of port RX rings owned by the worker */
+    int32_t cpu;                /**< CPU the worker is pinned to, -1 if not pinned */
+    uint32_t node;              /**< NUMA node of the worker's memory */
+} forwarding_worker_stats_t;
+
+/**
+ * @brief Fill a configuration with defaults
+ *
+ * @param[out] config Configuration to fill
+ */
+void forwarding_get_default_config(forwarding_config_t *config);
+
+/**
+ * @brief Create the worker pool and start forwarding
+ *
+ * Requires the packet subsystem and the hardware simulation to be
+ * initialized. Packets not consumed by a processor are freed by the
+ * workers.
+ *
+ * @param config Configuration (NULL for defaults)
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t forwarding_init(const forwarding_config_t *config);
+
+/**
+ * @brief Stop and join all workers and free the worker queues
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not running
+ */
+status_t forwarding_shutdown(void);
+
+/**
+ * @brief Get the number of running workers
+ *
+ * @return Worker count (0 if not running)
+ */
+uint32_t forwarding_get_worker_count(void);
+
+/**
+ * @brief Get the worker that processes a flow hash
+ *
+ * @param flow_hash Hash from packet_flow_hash()
+ * @return Worker index
+ */
+uint32_t forwarding_worker_for_hash(uint32_t flow_hash);
+
+/**
+ * @brief Get the worker running on the calling thread
+ *
+ * Pipeline stages use it to keep per-worker state without locks.
+ *
+ * @return Worker index, UINT32_MAX if the caller is not a worker
+ */
+uint32_t forwarding_current_worker(void);
+
+/**
+ * @brief Get counters of one worker
+ *
+ * The time in an idle state is added when the worker leaves it, when a
+ * block ends, and every so many rounds in between.
+ *
+ * @param worker Worker index
+ * @param[out] stats Worker counters
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t forwarding_get_worker_stats(uint32_t worker, forwarding_worker_stats_t *stats);
+
+#endif /* SWITCH_SIM_FORWARDING_H */
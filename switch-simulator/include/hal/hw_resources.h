@@ -12,6 +12,7 @@
 
 #include "../common/types.h"
 #include "../common/error_codes.h"
+#include "../common/mem_arena.h"
 
 #include "port_types.h"  // Добавляем включение нового файла
 
@@ -37,6 +38,7 @@ typedef struct {
     uint32_t used;             /**< Currently used resources */
     uint32_t reserved;         /**< Reserved for system use */
     uint32_t available;        /**< Available for allocation */
+    mem_arena_stats_t arena;   /**< Memory arena holding the resource, all zero if none */
 } hw_resource_usage_t;
 
 /**
@@ -115,6 +117,9 @@ status_t hw_sim_get_port_config(port_id_t port_id, port_config_t *config);
 /**
  * @brief Get hardware resource usage
  *
+ * Packet buffers, the MAC table and the routing table also report the
+ * memory arena they live in: the packet_pool, mac_table and fib arenas.
+ *
  * @param resource Resource type
  * @param[out] usage Resource usage information
  * @return status_t STATUS_SUCCESS if successful
@@ -129,6 +134,20 @@ status_t hw_resources_get_usage(hw_resource_type_t resource, hw_resource_usage_t
  */
 status_t hw_resources_get_capabilities(hw_capabilities_t *capabilities);
 
+/**
+ * @brief Size the budget of a resource type from the board profile
+ *
+ * The BSP owns the board's resource pools; this makes the HAL budgets of
+ * reserve-and-release resources (ACL entries, counters, queues) match
+ * them, so exhaustion happens where it would on the target board.
+ *
+ * @param resource Resource type
+ * @param total Resources of the board
+ * @return status_t STATUS_SUCCESS if successful, STATUS_RESOURCE_BUSY if
+ *         more than total is already reserved
+ */
+status_t hw_resources_set_total(hw_resource_type_t resource, uint32_t total);
+
 /**
  * @brief Reserve hardware resources
  *
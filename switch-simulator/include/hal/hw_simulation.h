@@ -0,0 +1,325 @@
+/**
+ * @file hw_simulation.h
+ * @brief Hardware simulation packet I/O interface for switch simulator
+ *
+ * Each simulated port has an RX and a TX ring of CONFIG_RING_BUFFER_SIZE
+ * packets. Rings are single-producer/single-consumer: per port, one driver
+ * thread receives and drains TX, and one forwarding worker polls RX and
+ * queues TX. Packets that do not fit are dropped and counted.
+ */
+
+#ifndef SWITCH_SIM_HW_SIMULATION_H
+#define SWITCH_SIM_HW_SIMULATION_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "port.h"
+#include "packet.h"
+
+/**
+ * @brief Per-port ring counters
+ */
+typedef struct {
+    uint64_t rx_enqueued;       /**< Packets accepted by the RX ring */
+    uint64_t rx_dequeued;       /**< Packets taken by forwarding workers */
+    uint64_t rx_ring_full;      /**< Packets dropped because the RX ring was full */
+    uint64_t tx_enqueued;       /**< Packets accepted by the TX ring */
+    uint64_t tx_dequeued;       /**< Packets sent by the driver side */
+    uint64_t tx_ring_full;      /**< Packets dropped because the TX ring was full */
+    uint32_t rx_occupancy;      /**< Packets currently waiting in the RX ring */
+    uint32_t tx_occupancy;      /**< Packets currently waiting in the TX ring */
+} hw_sim_ring_stats_t;
+
+/**
+ * @brief Initialize hardware simulation
+ *
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_sim_init(void);
+
+/**
+ * @brief Shutdown hardware simulation
+ *
+ * Packets still queued in the rings are freed.
+ *
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_sim_shutdown(void);
+
+/**
+ * @brief Simulate packet reception
+ *
+ * Queues the packet on the port RX ring. On success the ring owns the
+ * packet; otherwise the caller keeps it.
+ *
+ * @param port_id Ingress port ID
+ * @param packet Packet buffer with data
+ * @return status_t STATUS_SUCCESS if successful, STATUS_RESOURCE_EXHAUSTED
+ *         if the RX ring is full
+ */
+status_t hw_sim_receive_packet(port_id_t port_id, packet_buffer_t *packet);
+
+/**
+ * @brief Queue a burst of received packets on the port RX ring
+ *
+ * Packets beyond the free ring space are not taken and are counted as
+ * ring-full drops; the caller still owns them.
+ *
+ * @param port_id Ingress port ID
+ * @param pkts Received packets
+ * @param count Number of packets
+ * @return Number of packets queued (a prefix of pkts)
+ */
+uint32_t hw_sim_rx_enqueue_burst(port_id_t port_id, packet_buffer_t **pkts, uint32_t count);
+
+/**
+ * @brief Take up to max packets from the port RX ring
+ *
+ * @param port_id Ingress port ID
+ * @param pkts Output array for the packets
+ * @param max Maximum number of packets to take
+ * @return Number of packets returned
+ */
+uint32_t hw_sim_rx_dequeue_burst(port_id_t port_id, packet_buffer_t **pkts, uint32_t max);
+
+/**
+ * @brief Move the port RX ring to the NUMA node of the worker draining it
+ *
+ * @param port_id Ingress port ID
+ * @param node NUMA node, see sim_numa.h
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t hw_sim_rx_ring_set_node(port_id_t port_id, uint32_t node);
+
+/**
+ * @brief Notification that packets were queued on a port RX or TX ring
+ *
+ * Called by hw_sim_rx_enqueue_burst() on the receiving thread, and by
+ * hw_sim_tx_enqueue_burst() on the sending one, after the packets are
+ * queued, so the thread draining the port's rings can be woken.
+ *
+ * @param port_id Ingress port
+ * @param user_data Context given when the notification was set
+ */
+typedef void (*hw_sim_rx_notify_t)(port_id_t port_id, void *user_data);
+
+/**
+ * @brief Set the notification of the port RX and TX rings
+ *
+ * Replaces any previous one. A call already in progress may still reach
+ * the old notification after this returns.
+ *
+ * @param port_id Ingress port ID
+ * @param notify Function to call, NULL to remove
+ * @param user_data Context passed to it
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t hw_sim_rx_ring_set_notify(port_id_t port_id, hw_sim_rx_notify_t notify, void *user_data);
+
+/**
+ * @brief Run up to budget packets from the port RX ring through the pipeline
+ *
+ * Packets are processed in bursts with packet_process_burst(). Packets
+ * not consumed by a processor are freed.
+ *
+ * @param port_id Ingress port ID
+ * @param budget Maximum number of packets to process
+ * @return Number of packets processed
+ */
+uint32_t hw_sim_rx_poll(port_id_t port_id, uint32_t budget);
+
+/**
+ * @brief Simulate packet transmission
+ *
+ * Sends the packet synchronously: checks link and MTU and updates the
+ * port counters. The caller keeps ownership of the packet.
+ *
+ * @param packet Packet buffer to transmit
+ * @param port_id Egress port ID
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_sim_transmit_packet(packet_buffer_t *packet, port_id_t port_id);
+
+/**
+ * @brief Simulate transmission of a burst of packets
+ *
+ * As hw_sim_transmit_packet() for each packet, with the link checked and
+ * the port counters updated once for the burst. The caller keeps
+ * ownership of the packets.
+ *
+ * @param port_id Egress port ID
+ * @param pkts Packets to transmit
+ * @param count Number of packets
+ * @return Number of packets sent; the others were dropped
+ */
+uint32_t hw_sim_transmit_burst(port_id_t port_id, packet_buffer_t **pkts, uint32_t count);
+
+/**
+ * @brief Queue a burst of packets on the port TX ring
+ *
+ * On success the ring owns the queued packets. Packets beyond the free
+ * ring space are not taken and are counted as ring-full drops. On a port
+ * with QoS enabled the packets go to its egress queues instead, and pkts
+ * is reordered so that the packets the queues took come first. The
+ * port's egress policer, if any, is applied first and the packets it
+ * drops are moved to the end. Any thread may call this.
+ *
+ * @param port_id Egress port ID
+ * @param pkts Packets to send
+ * @param count Number of packets
+ * @return Number of packets queued (a prefix of pkts)
+ */
+uint32_t hw_sim_tx_enqueue_burst(port_id_t port_id, packet_buffer_t **pkts, uint32_t count);
+
+/**
+ * @brief Send up to budget packets from the port TX ring
+ *
+ * Packets leave in bursts through the port driver's transmit_burst op,
+ * or hw_sim_transmit_burst() if the port has none, and are then freed.
+ * Once the ring is empty, packets are taken from the port's egress queues
+ * in scheduler order. A driver's transmit_burst must not queue on the
+ * TX ring again. Only one thread drains a port: under forwarding_init()
+ * that is the worker owning the port.
+ *
+ * @param port_id Egress port ID
+ * @param budget Maximum number of packets to send
+ * @return Number of packets taken from the ring
+ */
+uint32_t hw_sim_tx_drain(port_id_t port_id, uint32_t budget);
+
+/**
+ * @brief Get ring counters of a port
+ *
+ * @param port_id Port identifier
+ * @param[out] stats Ring counters
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_sim_get_ring_stats(port_id_t port_id, hw_sim_ring_stats_t *stats);
+
+/**
+ * @brief Get hardware port information
+ *
+ * @param port_id Port identifier
+ * @param[out] info Port information structure to fill
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_sim_get_port_info(port_id_t port_id, port_info_t *info);
+
+/**
+ * @brief Get the operational state of a port without locking
+ *
+ * @param port_id Port identifier
+ * @param[out] state Operational state
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_sim_get_port_state(port_id_t port_id, port_state_t *state);
+
+/**
+ * @brief Get the statistics of a port, folded from the per-thread counters
+ *
+ * @param port_id Port identifier
+ * @param[out] stats Statistics
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_sim_get_port_stats(port_id_t port_id, port_stats_t *stats);
+
+/**
+ * @brief Get the version of a port's configuration and operational state
+ *
+ * The version changes whenever the configuration is set or the link
+ * state changes, so callers can cache what they derive from them.
+ *
+ * @param port_id Port identifier
+ * @return Version, 0 for an invalid port
+ */
+uint32_t hw_sim_get_port_version(port_id_t port_id);
+
+/**
+ * @brief Set the offloads of a port's emulated NIC
+ *
+ * The emulated NIC always finishes the checksums and TSO frames put on
+ * its wire; the flags only decide what the port advertises to the stack
+ * and whether received frames get checksum verdicts.
+ *
+ * @param port_id Port identifier
+ * @param offloads DRIVER_FLAG_TX_CSUM, DRIVER_FLAG_TSO and DRIVER_FLAG_RX_CSUM
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_sim_set_port_offloads(port_id_t port_id, uint32_t offloads);
+
+/**
+ * @brief Get the offloads a port advertises
+ *
+ * @param port_id Port identifier
+ * @return Offload flags of the port's driver, or of its emulated NIC when
+ *         it has none; 0 for an invalid port
+ */
+uint32_t hw_sim_get_port_offloads(port_id_t port_id);
+
+/**
+ * @brief Get the number of ports in hardware
+ *
+ * @param[out] count Pointer to store port count
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_sim_get_port_count(uint32_t *count);
+
+/**
+ * @brief Reset all statistics for a port
+ *
+ * @param port_id Port identifier
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_sim_clear_port_stats(port_id_t port_id);
+
+/**
+ * @brief Callback for port link state changes
+ *
+ * Called with the port's lock held, so it must not block or call back
+ * into the port API.
+ *
+ * @param port_id Port whose link changed
+ * @param state New operational state
+ * @param user_data Context given at registration
+ */
+typedef void (*hw_sim_link_callback_t)(port_id_t port_id, port_state_t state, void *user_data);
+
+/**
+ * @brief Register the subscriber for port link state changes
+ *
+ * Replaces any previous subscriber.
+ *
+ * @param callback Function to call, NULL to unregister
+ * @param user_data Context passed to the callback
+ * @return status_t STATUS_SUCCESS
+ */
+status_t hw_sim_register_link_callback(hw_sim_link_callback_t callback, void *user_data);
+
+/**
+ * @brief Observer of received packets
+ *
+ * Called by hw_sim_rx_enqueue_burst() on the receiving thread before the
+ * packets are parsed or queued. It may read the packets but must not keep,
+ * change or free them.
+ *
+ * @param port_id Ingress port
+ * @param pkts Packets offered to the port
+ * @param count Number of packets
+ * @param user_data Context given when the tap was set
+ */
+typedef void (*hw_sim_rx_tap_t)(port_id_t port_id, packet_buffer_t *const *pkts, uint32_t count,
+                                void *user_data);
+
+/**
+ * @brief Set the observer of received packets
+ *
+ * Replaces any previous tap. A call already in progress may still reach
+ * the old tap after this returns.
+ *
+ * @param tap Function to call, NULL to remove
+ * @param user_data Context passed to the tap
+ * @return status_t STATUS_SUCCESS
+ */
+status_t hw_sim_set_rx_tap(hw_sim_rx_tap_t tap, void *user_data);
+
+#endif /* SWITCH_SIM_HW_SIMULATION_H */
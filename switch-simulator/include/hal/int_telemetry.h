@@ -0,0 +1,220 @@
+/**
+ * @file int_telemetry.h
+ * @brief In-band network telemetry: per-hop records carried in the packet
+ *
+ * Packets of the flows chosen by ACL rules with int_watch set collect one
+ * record per switch they cross: the switch ID, the ports the packet came
+ * in and went out by, the time it spent in the switch and how many
+ * packets it left behind in its egress queue. The first switch on the
+ * path (the source) inserts a shim header after the TCP or UDP header;
+ * every further switch (a transit hop) recognizes the shim by the DSCP
+ * mark and adds its record; the port that hands the packet to its
+ * destination (a sink port) takes the shim out again, restores the DSCP
+ * and feeds the records to per-hop statistics, which the statistics
+ * module reports as TELEMETRY_OBJ_INT objects. Only IPv4 is stamped.
+ *
+ * Layout after the transport header, in network byte order:
+ *
+ *   0   version << 4 | flags      INT_VERSION, INT_SHIM_F_*
+ *   1   hop records that follow
+ *   2   most hop records allowed
+ *   3   DSCP of the packet before it was marked
+ *   4   length of shim and records in bytes
+ *   6   hops that found no room for their record
+ *   8   hop records, newest first, INT_HOP_LEN bytes each:
+ *       0  switch ID (32 bits)
+ *       4  ingress port (16 bits)
+ *       6  egress port (16 bits)
+ *       8  hop latency in nanoseconds (32 bits, saturated)
+ *       12 egress queue (8 bits) and its occupancy in packets (24 bits, saturated)
+ *
+ * A hop's latency runs from the RX ring to the egress scheduler taking
+ * the packet, on CLOCK_MONOTONIC. Checksums are updated incrementally, or
+ * left to the offload that is still to fill them in. A hop does not grow
+ * a packet past the egress MTU, nor touch TSO frames or fragments.
+ *
+ * With the mode off the data path pays one flag load per burst; with it
+ * on, one clock read per received burst, and the work above only for the
+ * packets of watched flows.
+ */
+#ifndef SWITCH_SIM_INT_TELEMETRY_H
+#define SWITCH_SIM_INT_TELEMETRY_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../common/config.h"
+#include "packet.h"
+
+#define INT_VERSION             1       /**< Shim version */
+#define INT_SHIM_LEN            8       /**< Bytes of the shim header */
+#define INT_HOP_LEN             16      /**< Bytes of one hop record */
+#define INT_SHIM_F_EXCEEDED     0x1     /**< A hop found the record stack full */
+
+/**
+ * @brief DSCP bit marking packets that carry a shim
+ *
+ * The lowest bit, which the class selector, AF and EF code points all
+ * leave clear, so the mark does not change how a packet is queued.
+ */
+#define INT_DSCP_MARK           0x01
+
+/**
+ * @brief Role of a packet, packet_metadata_t.int_watch
+ */
+#define INT_WATCH_NONE          0       /**< Not stamped */
+#define INT_WATCH_SOURCE        1       /**< Chosen by an ACL rule here; gets a shim */
+#define INT_WATCH_TRANSIT       2       /**< Arrived with a shim */
+
+/**
+ * @brief INT configuration
+ */
+typedef struct {
+    bool enabled;               /**< Stamp watched packets */
+    uint32_t switch_id;         /**< ID in the records of this switch */
+    uint8_t max_hops;           /**< Hop records a shim made here holds, 1 to CONFIG_INT_MAX_HOPS, 0 for the most */
+} int_telemetry_config_t;
+
+/**
+ * @brief Statistics a sink keeps for one hop
+ */
+typedef struct {
+    uint32_t switch_id;
+    port_id_t egress_port;
+    uint64_t packets;           /**< Records received */
+    uint64_t latency_total_ns;  /**< Sum of hop latencies */
+    uint64_t latency_max_ns;
+    uint64_t depth_total;       /**< Sum of queue occupancies */
+    uint64_t depth_max;
+} int_telemetry_hop_stats_t;
+
+/**
+ * @brief INT counters of this switch
+ */
+typedef struct {
+    uint64_t sourced;           /**< Shims inserted */
+    uint64_t stamped;           /**< Hop records added to transit packets */
+    uint64_t sunk;              /**< Shims taken out at sink ports */
+    uint64_t records;           /**< Hop records fed to the sink statistics */
+    uint64_t exceeded;          /**< Transit hops that found the stack full */
+    uint64_t mtu_skipped;       /**< Hops that would have grown a packet past the MTU */
+    uint64_t unsupported;       /**< Watched packets that could not be stamped */
+    uint64_t untracked;         /**< Records of hops beyond CONFIG_INT_SINK_SLOTS */
+} int_telemetry_stats_t;
+
+#if CONFIG_ENABLE_INT
+/** Set while the mode is on; read by the data path */
+extern bool g_int_enabled;
+#endif
+
+/**
+ * @brief Check whether the mode is on
+ */
+static inline bool int_telemetry_enabled(void) {
+#if CONFIG_ENABLE_INT
+    return __atomic_load_n(&g_int_enabled, __ATOMIC_RELAXED);
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Initialize INT, off; called by the hardware simulation
+ *
+ * @return STATUS_SUCCESS or STATUS_NO_MEMORY
+ */
+status_t int_telemetry_init(void);
+
+/**
+ * @brief Release INT state
+ */
+void int_telemetry_shutdown(void);
+
+/**
+ * @brief Switch the mode on or off and set this switch's ID
+ *
+ * @param config Configuration, copied
+ * @return STATUS_SUCCESS, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER,
+ *         or STATUS_NOT_SUPPORTED when built without CONFIG_ENABLE_INT
+ */
+status_t int_telemetry_configure(const int_telemetry_config_t *config);
+
+/**
+ * @brief Read the configuration
+ *
+ * @param[out] config Configuration
+ * @return STATUS_SUCCESS or STATUS_INVALID_PARAMETER
+ */
+status_t int_telemetry_get_config(int_telemetry_config_t *config);
+
+/**
+ * @brief Make a port a sink, where shims are taken out, or a transit port
+ *
+ * @param port_id Port
+ * @param sink Whether the port is a sink
+ * @return STATUS_SUCCESS, STATUS_NOT_INITIALIZED or STATUS_INVALID_PARAMETER
+ */
+status_t int_telemetry_set_sink(port_id_t port_id, bool sink);
+
+/**
+ * @brief Time and classify a parsed burst taken by a port; only when the mode is on
+ *
+ * @param pkts Packets
+ * @param count Number of packets
+ */
+void int_telemetry_rx_burst(packet_buffer_t **pkts, uint32_t count);
+
+/**
+ * @brief Note the egress queue a packet left and its occupancy
+ *
+ * Called by the scheduler as it takes packets; does nothing for packets
+ * that are not watched.
+ *
+ * @param packet Packet
+ * @param queue Queue
+ * @param depth Packets still in the queue
+ */
+static inline void int_telemetry_note_queue(packet_buffer_t *packet, uint8_t queue, uint32_t depth) {
+#if CONFIG_ENABLE_INT
+    if (packet->metadata.int_watch != INT_WATCH_NONE) {
+        packet->metadata.int_queue = queue;
+        packet->metadata.int_depth = depth;
+    }
+#else
+    (void)packet;
+    (void)queue;
+    (void)depth;
+#endif
+}
+
+/**
+ * @brief Stamp the watched packets of a burst leaving a port; only when the mode is on
+ *
+ * Adds this hop's record, inserting the shim at the source, and takes
+ * the shim out again at a sink port.
+ *
+ * @param port_id Egress port
+ * @param mtu Egress MTU, the largest frame in bytes
+ * @param pkts Packets
+ * @param count Number of packets
+ */
+void int_telemetry_egress_burst(port_id_t port_id, uint32_t mtu, packet_buffer_t **pkts, uint32_t count);
+
+/**
+ * @brief Read the statistics of one hop seen by the sink ports
+ *
+ * @param slot Slot, below CONFIG_INT_SINK_SLOTS
+ * @param[out] stats Statistics
+ * @return STATUS_SUCCESS, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER,
+ *         or STATUS_NOT_FOUND if the slot holds no hop
+ */
+status_t int_telemetry_get_hop(uint32_t slot, int_telemetry_hop_stats_t *stats);
+
+/**
+ * @brief Read the counters
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS, STATUS_NOT_INITIALIZED or STATUS_INVALID_PARAMETER
+ */
+status_t int_telemetry_get_stats(int_telemetry_stats_t *stats);
+
+#endif /* SWITCH_SIM_INT_TELEMETRY_H */
@@ -0,0 +1,196 @@
+/**
+ * @file link_event.h
+ * @brief Coalesced and dampened port link events
+ *
+ * Drivers report every link transition here instead of calling the L2
+ * and L3 handlers directly. Transitions are collected for a short
+ * coalescing interval and then delivered to the subscribers as one batch:
+ * a bitmap of the ports whose state changed and their new states. A port
+ * that bounces and comes back within the interval is not reported at all,
+ * and a mass flap of every port costs each subscriber one call.
+ *
+ * A port that keeps flapping is dampened, as in IP event dampening: each
+ * down transition adds a penalty that decays exponentially with the
+ * configured half-life. Once the penalty exceeds the suppress threshold
+ * the port is reported down and stays so until the penalty decays below
+ * the reuse threshold, however its link behaves meanwhile. The penalty is
+ * capped so suppression after the last flap never outlasts max_suppress_ms.
+ *
+ * Coalescing and reuse run on event loop timers; without the event loop
+ * every report is delivered at once.
+ */
+
+#ifndef SWITCH_SIM_LINK_EVENT_H
+#define SWITCH_SIM_LINK_EVENT_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../common/bitmap.h"
+#include "../common/config.h"
+
+/** Number of 64-bit words in a link event port bitmap */
+#define LINK_EVENT_PORT_WORDS CONFIG_PORT_BITMAP_WORDS
+
+/** Subscribers served */
+#define LINK_EVENT_MAX_SUBSCRIBERS 8
+
+/**
+ * @brief Ports whose reported link state changed, bit n of word n / 64 for port n
+ */
+typedef struct {
+    uint64_t changed[LINK_EVENT_PORT_WORDS];   /**< Ports in the batch */
+    uint64_t up[LINK_EVENT_PORT_WORDS];        /**< New state of those ports, set for up */
+    uint32_t count;                            /**< Ports in the batch */
+} link_event_batch_t;
+
+/**
+ * @brief Batch subscriber, runs outside the module lock
+ *
+ * @param batch Changed ports
+ * @param arg User argument given to link_event_subscribe()
+ */
+typedef void (*link_event_cb_t)(const link_event_batch_t *batch, void *arg);
+
+/**
+ * @brief Dampening parameters
+ *
+ * Penalties are in the usual units of 1000 per flap.
+ */
+typedef struct {
+    bool enabled;
+    uint32_t penalty;               /**< Added per down transition */
+    uint32_t suppress_threshold;    /**< Suppress above this */
+    uint32_t reuse_threshold;       /**< Release below this */
+    uint32_t half_life_ms;          /**< Penalty halves in this time */
+    uint32_t max_suppress_ms;       /**< Longest suppression after the last flap */
+} link_dampening_config_t;
+
+/**
+ * @brief Link event parameters
+ */
+typedef struct {
+    uint32_t coalesce_ms;           /**< Collection interval, 0 to deliver at once */
+    link_dampening_config_t dampening;
+} link_event_config_t;
+
+/**
+ * @brief Link event state of a port
+ */
+typedef struct {
+    bool link_up;                   /**< Last reported by the driver */
+    bool delivered_up;              /**< Last delivered to subscribers */
+    bool suppressed;                /**< Held down by dampening */
+    uint32_t penalty;               /**< Current, decayed penalty */
+    uint64_t flaps;                 /**< Down transitions reported */
+} link_event_port_info_t;
+
+/**
+ * @brief Link event counters
+ */
+typedef struct {
+    uint64_t reported;              /**< Transitions reported by drivers */
+    uint64_t batches;               /**< Batches delivered */
+    uint64_t changes;               /**< Port changes delivered */
+    uint64_t coalesced;             /**< Transitions that cancelled out within an interval */
+    uint64_t suppressions;          /**< Times a port was suppressed */
+} link_event_stats_t;
+
+/**
+ * @brief Get the default parameters
+ *
+ * 10 ms coalescing; dampening off, with penalty 1000, suppress 2000,
+ * reuse 750, a 15 s half-life and 60 s maximum suppression.
+ *
+ * @param[out] config Parameters
+ */
+void link_event_get_default_config(link_event_config_t *config);
+
+/**
+ * @brief Initialize link events with every port up
+ *
+ * @param config Parameters, NULL for the defaults
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t link_event_init(const link_event_config_t *config);
+
+/**
+ * @brief Stop the timers and drop undelivered changes
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t link_event_shutdown(void);
+
+/**
+ * @brief Change the parameters; dampening state is kept
+ *
+ * @param config Parameters
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t link_event_set_config(const link_event_config_t *config);
+
+/**
+ * @brief Report a link transition; may be called from any thread
+ *
+ * @param port_id Port
+ * @param link_up New link state
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t link_event_report(port_id_t port_id, bool link_up);
+
+/**
+ * @brief Deliver the collected changes now
+ *
+ * @return Number of ports delivered
+ */
+uint32_t link_event_flush(void);
+
+/**
+ * @brief Subscribe to batches; works before link_event_init()
+ *
+ * @param cb Subscriber
+ * @param arg User argument
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_RESOURCE_EXHAUSTED
+ */
+status_t link_event_subscribe(link_event_cb_t cb, void *arg);
+
+/**
+ * @brief Remove a subscriber
+ *
+ * @param cb Subscriber
+ * @param arg User argument it subscribed with
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t link_event_unsubscribe(link_event_cb_t cb, void *arg);
+
+/**
+ * @brief Get the link event state of a port
+ *
+ * @param port_id Port
+ * @param[out] info State
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t link_event_get_port_info(port_id_t port_id, link_event_port_info_t *info);
+
+/**
+ * @brief Get the counters
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t link_event_get_stats(link_event_stats_t *stats);
+
+/**
+ * @brief Check if a port is in a batch
+ */
+static inline bool link_event_batch_has(const link_event_batch_t *batch, port_id_t port_id) {
+    return port_id < CONFIG_MAX_PORTS && bitmap_test(batch->changed, port_id);
+}
+
+/**
+ * @brief New state of a port in a batch
+ */
+static inline bool link_event_batch_up(const link_event_batch_t *batch, port_id_t port_id) {
+    return port_id < CONFIG_MAX_PORTS && bitmap_test(batch->up, port_id);
+}
+
+#endif /* SWITCH_SIM_LINK_EVENT_H */
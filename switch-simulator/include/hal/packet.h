@@ -24,6 +24,7 @@
 
 #include "../common/types.h"
 #include "../common/error_codes.h"
+#include "../common/config.h"
 
 #define MAX_PACKET_SIZE 9216  // Support for jumbo frames
 
@@ -69,6 +70,60 @@ typedef enum {
     PACKET_DIR_INVALID    /**< Invalid/uninitialized packet direction */
 } packet_direction_t;
 
+/**
+ * @brief Maximum number of VLAN tags recorded by the header parser
+ */
+#define PACKET_MAX_VLAN_TAGS    2
+
+/**
+ * @brief Maximum number of MPLS label stack entries recorded by the header parser
+ */
+#define PACKET_MAX_MPLS_LABELS  4
+
+/**
+ * @brief Header cache validity flags (packet_metadata_t.parsed)
+ */
+#define PACKET_PARSED_DONE      0x0001  /**< Parser ran on the current data */
+#define PACKET_PARSED_L2        0x0002  /**< Ethernet header and VLAN stack are complete */
+#define PACKET_PARSED_L3        0x0004  /**< l3_offset points at a complete IP header */
+#define PACKET_PARSED_L4        0x0008  /**< l4_offset points at the transport header */
+#define PACKET_PARSED_HASH      0x0010  /**< flow_hash is valid */
+#define PACKET_PARSED_MPLS      0x0020  /**< Label stack is complete down to the bottom of stack */
+
+/**
+ * @brief Protocol flags set by the header parser (packet_metadata_t.proto_flags)
+ */
+#define PACKET_PROTO_VLAN       0x0001  /**< At least one 802.1Q/802.1ad tag */
+#define PACKET_PROTO_QINQ       0x0002  /**< Two or more VLAN tags */
+#define PACKET_PROTO_L2_MCAST   0x0004  /**< Multicast destination MAC */
+#define PACKET_PROTO_L2_BCAST   0x0008  /**< Broadcast destination MAC */
+#define PACKET_PROTO_ARP        0x0010  /**< ARP payload */
+#define PACKET_PROTO_IPV4       0x0020  /**< IPv4 payload */
+#define PACKET_PROTO_IPV6       0x0040  /**< IPv6 payload */
+#define PACKET_PROTO_IP_OPTIONS 0x0080  /**< IPv4 options or IPv6 extension headers */
+#define PACKET_PROTO_IP_FRAG    0x0100  /**< IP fragment */
+#define PACKET_PROTO_TCP        0x0200  /**< TCP transport */
+#define PACKET_PROTO_UDP        0x0400  /**< UDP transport */
+#define PACKET_PROTO_ICMP       0x0800  /**< ICMP or ICMPv6 */
+#define PACKET_PROTO_IPV6_ROUTING 0x1000 /**< IPv6 Routing header */
+#define PACKET_PROTO_MPLS       0x2000  /**< MPLS label stack at l3_offset */
+
+/**
+ * @brief Checksum and segmentation offload flags (packet_metadata_t.offload)
+ *
+ * TX flags mark work left to the egress driver; a packet only carries
+ * them towards a port that advertised the matching DRIVER_FLAG_*. RX flags
+ * are set by a driver with DRIVER_FLAG_RX_CSUM after it checked the frame.
+ */
+#define PACKET_OFFLOAD_IP_CSUM      0x0001  /**< TX: IPv4 header checksum not filled in */
+#define PACKET_OFFLOAD_L4_CSUM      0x0002  /**< TX: TCP/UDP checksum not filled in */
+#define PACKET_OFFLOAD_TSO          0x0004  /**< TX: TCP payload to be cut into tso_mss segments */
+#define PACKET_OFFLOAD_TX_MASK      0x000F
+#define PACKET_OFFLOAD_RX_IP_GOOD   0x0010  /**< RX: IPv4 header checksum verified */
+#define PACKET_OFFLOAD_RX_L4_GOOD   0x0020  /**< RX: TCP/UDP checksum verified */
+#define PACKET_OFFLOAD_RX_BAD       0x0040  /**< RX: a checksum was found wrong */
+#define PACKET_OFFLOAD_RX_MASK      0x00F0
+
 /**
  * @brief Packet metadata structure
  */
@@ -83,24 +138,94 @@ typedef struct {
     bool is_tagged;              /**< VLAN tagged flag */
     bool is_dropped;             /**< Packet drop flag */
     uint32_t timestamp;          /**< Packet timestamp */
+
+    /* Header cache filled by packet_parse(); offsets are relative to data */
+    uint16_t parsed;             /**< PACKET_PARSED_* flags */
+    uint16_t proto_flags;        /**< PACKET_PROTO_* flags */
+    uint16_t l3_offset;          /**< Start of the network header */
+    uint16_t l4_offset;          /**< Start of the transport header */
+    uint8_t  vlan_count;         /**< Number of VLAN tags found */
+    uint8_t  l4_proto;           /**< IPv4 protocol / final IPv6 next header */
+    uint16_t vlan_tpid[PACKET_MAX_VLAN_TAGS]; /**< TPIDs, outermost first */
+    uint16_t vlan_tci[PACKET_MAX_VLAN_TAGS];  /**< TCIs, outermost first */
+    uint32_t flow_hash;          /**< Flow hash, see packet_flow_hash() */
+    uint8_t  mpls_count;         /**< Number of label stack entries found */
+    uint32_t mpls_stack[PACKET_MAX_MPLS_LABELS]; /**< Label stack entries, top first */
+
+    uint16_t offload;            /**< PACKET_OFFLOAD_* flags */
+    uint16_t tso_mss;            /**< TCP payload bytes per segment with PACKET_OFFLOAD_TSO */
+    uint8_t  drop_reason;        /**< packet_drop_reason_t once the drop is counted */
+    uint8_t  color;              /**< policer_color_t given by the last policer, green if none */
+#if CONFIG_ENABLE_PIPELINE_PROFILING
+    uint64_t rx_cycles;          /**< Cycle counter when queued on an RX ring, 0 if not */
+#endif
+#if CONFIG_ENABLE_INT
+    uint8_t  int_watch;          /**< INT_WATCH_* role of the packet, see int_telemetry.h */
+    uint8_t  int_queue;          /**< Egress queue it left, set by the scheduler for watched packets */
+    uint32_t int_depth;          /**< Packets left behind in that queue */
+    uint64_t int_rx_ns;          /**< CLOCK_MONOTONIC when received, 0 if INT was off */
+#endif
 } packet_metadata_t;
 
+/**
+ * @brief Packet buffer ownership flags
+ */
+#define PACKET_FLAG_POOLED      0x0001  /**< Descriptor and data come from the packet pool */
+#define PACKET_FLAG_EXT_DATA    0x0002  /**< Data was moved out of the pool slot to the heap */
+#define PACKET_FLAG_SEGMENT     0x0004  /**< Segment-sized buffer, grown by chaining more segments */
+
+/**
+ * @brief Shared data block of cloned packet buffers (opaque)
+ */
+typedef struct packet_shared packet_shared_t;
+
 /**
  * @brief Packet buffer structure
+ *
+ * A packet may be a chain of buffers linked through next. The first
+ * buffer carries the metadata and must hold the headers; data, size and
+ * capacity always describe a single segment. Use packet_chain_length()
+ * for the length of the whole packet.
  */
-typedef struct {
+typedef struct packet_buffer {
     uint8_t *data;                  /**< Pointer to packet data */
     union {
       uint32_t length;              /**< Current length of packet data */
       uint32_t size;                /**< Current size of packet data */
     };
-    uint32_t capacity;              /**< Total capacity of buffer */
+    uint32_t capacity;              /**< Capacity of buffer starting at data */
+    uint8_t *head;                  /**< Start of buffer; data - head is the headroom */
     packet_metadata_t metadata;     /**< Packet metadata */
     void *user_data;                /**< User data pointer */
+    uint32_t flags;                 /**< PACKET_FLAG_* ownership flags */
+    packet_shared_t *shared;        /**< Shared data block, NULL if data is private */
+    volatile uint32_t slot_refs;    /**< Holders of the pool slot (descriptor and shared data) */
+    struct packet_buffer *next;     /**< Next segment of a chained packet, NULL for the last one */
 } packet_buffer_t;
 // Создаем псевдоним для packet_buffer_t
 typedef packet_buffer_t packet_t;
 
+/**
+ * @brief Packet buffer pool statistics
+ */
+typedef struct {
+    uint32_t pool_size;             /**< Number of slots in the pool */
+    uint32_t slot_data_size;        /**< Data capacity of a single pool slot */
+    uint32_t in_use;                /**< Pool slots currently handed out */
+    uint64_t alloc_count;           /**< Successful allocations (pool and heap) */
+    uint64_t free_count;            /**< Buffers released (pool and heap) */
+    uint64_t cache_hits;            /**< Allocations served from the per-thread cache */
+    uint64_t exhausted_count;       /**< Allocations that found the pool empty */
+    uint64_t oversize_count;        /**< Allocations larger than a pool slot */
+    uint64_t heap_fallback_count;   /**< Allocations served by malloc() */
+    uint32_t seg_pool_size;         /**< Number of slots in the segment pool */
+    uint32_t seg_data_size;         /**< Data capacity of a single segment */
+    uint32_t seg_in_use;            /**< Segment pool slots currently handed out */
+    uint64_t seg_exhausted_count;   /**< Segment allocations that found the segment pool empty */
+    uint32_t numa_nodes;            /**< NUMA nodes the pools are split over */
+    uint64_t remote_refills;        /**< Cache refills served by another node's slots */
+} packet_pool_stats_t;
+
 /**
  * @brief Packet processing result codes
  */
@@ -121,6 +246,72 @@ typedef struct {
 } ethernet_header_t;
 
 
+/**
+ * @brief Header cache accessors
+ *
+ * Only meaningful when the matching PACKET_PARSED_* flag is set; use
+ * packet_ensure_parsed() first.
+ */
+#define packet_is_parsed(p)         (((p)->metadata.parsed & PACKET_PARSED_DONE) != 0)
+#define packet_parsed_has(p, f)     (((p)->metadata.parsed & (f)) == (f))
+#define packet_has_proto(p, f)      (((p)->metadata.proto_flags & (f)) != 0)
+#define packet_l3_offset(p)         ((p)->metadata.l3_offset)
+#define packet_l4_offset(p)         ((p)->metadata.l4_offset)
+#define packet_l3_header(p)         ((p)->data + (p)->metadata.l3_offset)
+#define packet_l4_header(p)         ((p)->data + (p)->metadata.l4_offset)
+#define packet_ethertype(p)         ((p)->metadata.ethertype)
+#define packet_invalidate_parse(p)  ((p)->metadata.parsed = 0)
+#define packet_ensure_parsed(p)     (packet_is_parsed(p) ? STATUS_SUCCESS : packet_parse(p))
+
+/**
+ * @brief Parse packet headers once and cache the result in metadata
+ *
+ * Walks the Ethernet header, VLAN stack, MPLS label stack or IPv4/IPv6
+ * header (including IPv6 extension headers) and records the offsets, the
+ * final ethertype and protocol flags. The payload under a label stack is
+ * not parsed. Layers that are truncated are left out of
+ * metadata.parsed. The cache is dropped by every function that changes
+ * packet data, except the VLAN push/pop helpers, which shift the cached
+ * VLAN stack and offsets instead.
+ *
+ * @param packet Packet buffer
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PACKET if the frame is
+ *         shorter than an Ethernet header
+ */
+status_t packet_parse(packet_buffer_t *packet);
+
+/**
+ * @brief Get the flow hash of a packet
+ *
+ * RSS-style hash over the IP addresses, protocol and TCP/UDP ports or
+ * ICMP echo identifier, or over the MAC addresses, ethertype and outer
+ * VLAN for non-IP frames. The IP hash is symmetric: both directions of a
+ * flow hash alike, and so land on the same forwarding worker.
+ * IP fragments hash on addresses and protocol only, so all fragments of
+ * a datagram stay together. MPLS frames hash on the recorded labels and
+ * the addresses of an IP payload under the bottom of stack. The result is cached in metadata.
+ *
+ * @param packet Packet buffer
+ * @return Flow hash (0 for invalid packets)
+ */
+uint32_t packet_flow_hash(packet_buffer_t *packet);
+
+/**
+ * @brief Flow hash an unfragmented IPv4 packet with these fields would get
+ *
+ * Lets a header rewrite, such as NAT, choose fields whose packets a given
+ * worker receives.
+ *
+ * @param src Source address, network order
+ * @param dst Destination address, network order
+ * @param protocol IP protocol
+ * @param src_port TCP/UDP source port or ICMP echo identifier, network order
+ * @param dst_port TCP/UDP destination port, network order; unused for ICMP
+ * @return Flow hash, as packet_flow_hash() returns it
+ */
+uint32_t packet_flow_hash_ipv4(ipv4_addr_t src, ipv4_addr_t dst, uint8_t protocol,
+                               uint16_t src_port, uint16_t dst_port);
+
 /**
  * @brief Extract Ethernet header from packet
  *
@@ -149,6 +340,25 @@ status_t packet_get_vlan_id(const packet_buffer_t *packet, vlan_id_t *vlan_id);
  */
 typedef packet_result_t (*packet_process_cb_t)(packet_buffer_t *packet, void *user_data);
 
+/**
+ * @brief Maximum number of packets handed to a burst processor at once
+ */
+#define PACKET_BURST_MAX 64
+
+/**
+ * @brief Burst packet processing callback function type
+ *
+ * Called with the packets of a burst that are still being forwarded.
+ * The callback stores one result per packet in results.
+ *
+ * @param pkts Packets to process
+ * @param count Number of packets (at most PACKET_BURST_MAX)
+ * @param results Per-packet processing results to fill
+ * @param user_data User data supplied during callback registration
+ */
+typedef void (*packet_burst_process_cb_t)(packet_buffer_t **pkts, uint32_t count,
+                                          packet_result_t *results, void *user_data);
+
 /**
  * @brief Initialize packet processing subsystem
  * 
@@ -173,6 +383,62 @@ packet_buffer_t* packet_buffer_alloc(uint32_t size);
 
 
 
+/**
+ * @brief Allocate a single segment buffer
+ *
+ * Segments hold CONFIG_PACKET_SEGMENT_SIZE bytes after the usual headroom
+ * and come from a separate pool of small slots, falling back to the main
+ * pool and the heap. packet_append_data() on a segment or a chain grows
+ * the chain with new segments instead of failing.
+ *
+ * @return packet_buffer_t* New segment or NULL if failed
+ */
+packet_buffer_t* packet_segment_alloc(void);
+
+/**
+ * @brief Check whether a packet consists of more than one segment
+ */
+#define packet_is_chained(packet)   ((packet)->next != NULL)
+
+/**
+ * @brief Get the length of a packet over all its segments
+ *
+ * @param packet Packet buffer
+ * @return Total number of data bytes (0 for NULL)
+ */
+uint32_t packet_chain_length(const packet_buffer_t *packet);
+
+/**
+ * @brief Get the number of segments of a packet
+ *
+ * @param packet Packet buffer
+ * @return Segment count (0 for NULL)
+ */
+uint32_t packet_segment_count(const packet_buffer_t *packet);
+
+/**
+ * @brief Link a segment (or chain) after the last segment of a packet
+ *
+ * The packet takes ownership of the segment, which is freed with it.
+ * The segment's metadata is ignored.
+ *
+ * @param packet First segment of the packet
+ * @param segment Segment or chain to append
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t packet_chain_append(packet_buffer_t *packet, packet_buffer_t *segment);
+
+/**
+ * @brief Copy all segments into the first one and free the rest
+ *
+ * Needed only by code that works on packet->data directly past the
+ * first segment; the peek/copy/update functions handle chains.
+ *
+ * @param packet Packet buffer
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t packet_linearize(packet_buffer_t *packet);
+
 /**
  * @brief Создать новый пакет с capacity = MAX_PACKET_SIZE.
  * @param[out] out_pkt Указатель на указатель, куда положим результат.
@@ -195,11 +461,64 @@ void packet_destroy(packet_buffer_t *pkt);
 
 /**
  * @brief Free a previously allocated packet buffer
- * 
+ *
+ * All segments of a chained packet are freed.
+ *
  * @param packet Packet buffer to free
  */
 void packet_buffer_free(packet_buffer_t *packet);
 
+/**
+ * @brief Memory of the segment pool
+ *
+ * Lets a driver register the pool with a device so that frames are
+ * received straight into segments. Slot i starts at base + i * slot_size
+ * with its packet_buffer_t; the buffer (headroom, then data) follows at
+ * data_offset.
+ */
+typedef struct {
+    uint8_t *base;                  /**< Start of the arena, page aligned */
+    size_t size;                    /**< Bytes of the arena, a whole number of pages */
+    size_t slot_size;               /**< Bytes per slot */
+    uint32_t slot_count;            /**< Number of slots */
+    uint32_t data_offset;           /**< Offset of a slot's buffer from the slot */
+    uint32_t data_size;             /**< Bytes of a slot's buffer, headroom included */
+} packet_pool_region_t;
+
+/**
+ * @brief Describe the memory of the segment pool
+ *
+ * @param[out] region Arena and slot layout
+ * @return status_t STATUS_SUCCESS if successful, STATUS_NOT_INITIALIZED if
+ *         there is no segment pool
+ */
+status_t packet_get_segment_region(packet_pool_region_t *region);
+
+/**
+ * @brief Get packet buffer pool statistics
+ *
+ * @param[out] stats Pool statistics snapshot
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t packet_get_pool_stats(packet_pool_stats_t *stats);
+
+/**
+ * @brief Return the calling thread's cached pool slots to the shared pools
+ *
+ * Each thread keeps up to 32 free slots of each pool to itself. They are
+ * returned when the thread exits; a thread that stays but stops handling
+ * packets can give them back sooner. Must not run during packet_shutdown().
+ */
+void packet_pool_thread_flush(void);
+
+/**
+ * @brief Reset packet buffer pool counters
+ *
+ * Clears the cumulative counters; pool sizes and in-use counts are not
+ * affected.
+ */
+void packet_reset_pool_stats(void);
+
 /**
  * @brief Reset a packet buffer to its initial state
  *
@@ -232,24 +551,174 @@ status_t packet_peek_byte(const packet_buffer_t *packet, uint32_t offset, uint8_
 /**
  * @brief      Peek a block of data from packet buffer at given offset
  *
+ * Offsets count over all segments; the block may span segment boundaries.
+ *
  * @return     STATUS_SUCCESS                если успешно
  * @return     ERROR_INVALID_PARAMETER       если переданы некорректные аргументы
  * @return     ERROR_PACKET_OPERATION_FAILED если диапазон выходит за пределы текущего размера пакета
  */
 status_t packet_peek_data(const packet_buffer_t *packet, uint32_t offset, void *dest, uint32_t length);
 
+/**
+ * @brief      Copy a block of data out of a (possibly chained) packet
+ *
+ * Same as packet_peek_data(), but a zero length is accepted.
+ */
 status_t packet_copy_data(const packet_buffer_t *packet, uint32_t offset, void *dest, uint32_t length);
 
 /**
  * @brief      Update (overwrite) a block of data in packet buffer at given offset
  *
+ * Offsets count over all segments; only the touched segments are made
+ * writable.
+ *
  * @return     STATUS_SUCCESS                если успешно
  * @return     ERROR_INVALID_PARAMETER       если аргументы некорректны
  * @return     ERROR_PACKET_OPERATION_FAILED если запись выйдет за пределы текущего размера пакета
  */
 status_t packet_update_data(packet_buffer_t *packet, uint32_t offset, const void *src, uint32_t length);
 
+#define PACKET_PEEK_SCRATCH_SIZE    256     /**< Longest range packet_peek_ptr() linearizes */
+#define PACKET_PEEK_SCRATCH_SLOTS   4       /**< Linearized ranges a thread can hold at once */
+
+/**
+ * @brief      Get a pointer to a block of packet data without copying it
+ *
+ * A range inside one segment, as headers are, is returned in place. A
+ * range spanning segments is copied into a scratch slot of the calling
+ * thread; the slots are reused in turn, so each such pointer stays
+ * valid for the next PACKET_PEEK_SCRATCH_SLOTS - 1 spanning peeks of
+ * the thread. In either case the bytes are read-only: writes go
+ * through packet_write_ptr() or packet_update_data(), which keep
+ * clones apart. Nothing is logged; callers report the failure.
+ *
+ * @param packet Packet, possibly chained
+ * @param offset Offset over all segments
+ * @param length Number of bytes
+ * @return Pointer to the bytes, NULL if the range is out of bounds, or
+ *         spans segments and is longer than PACKET_PEEK_SCRATCH_SIZE
+ */
+const void *packet_peek_ptr(const packet_buffer_t *packet, uint32_t offset, uint32_t length);
+
+/**
+ * @brief      Get a writable pointer to a block of packet data
+ *
+ * The segment holding the range is made private first (see
+ * packet_make_writable()), so a header can be changed in place.
+ *
+ * @param packet Packet, possibly chained
+ * @param offset Offset over all segments
+ * @param length Number of bytes
+ * @return Pointer to the bytes, NULL if the range is out of bounds,
+ *         spans segments, or the segment cannot be made private
+ */
+void *packet_write_ptr(packet_buffer_t *packet, uint32_t offset, uint32_t length);
+
+
+
+/**
+ * @brief Get number of free bytes in front of packet data
+ */
+#define packet_headroom(packet)     ((uint32_t)((packet)->data - (packet)->head))
 
+/**
+ * @brief Get number of free bytes after packet data
+ */
+#define packet_tailroom(packet)     ((packet)->capacity - (packet)->size)
+
+/**
+ * @brief Prepend space for a header in front of packet data
+ *
+ * Uses headroom when available so no payload bytes are moved; otherwise
+ * the payload is shifted (and the buffer grown if needed).
+ *
+ * @param packet Packet buffer
+ * @param length Number of bytes to prepend
+ * @param[out] header_out Start of the new header space (may be NULL)
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t packet_push_header(packet_buffer_t *packet, uint32_t length, uint8_t **header_out);
+
+/**
+ * @brief Strip a header from the front of packet data
+ *
+ * The removed bytes become headroom and stay readable until overwritten.
+ *
+ * @param packet Packet buffer
+ * @param length Number of bytes to strip
+ * @param[out] header_out Start of the removed header (may be NULL)
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t packet_pull_header(packet_buffer_t *packet, uint32_t length, uint8_t **header_out);
+
+/**
+ * @brief Insert an 802.1Q/802.1ad tag after the MAC addresses in place
+ *
+ * @param packet Packet buffer
+ * @param tpid Tag protocol identifier (ETHERTYPE_VLAN or ETHERTYPE_QINQ)
+ * @param tci Tag control information (PCP, DEI, VID)
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t packet_vlan_push(packet_buffer_t *packet, uint16_t tpid, uint16_t tci);
+
+/**
+ * @brief Remove the outermost 802.1Q/802.1ad tag in place
+ *
+ * @param packet Packet buffer
+ * @param[out] tci_out Removed tag control information (may be NULL)
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t packet_vlan_pop(packet_buffer_t *packet, uint16_t *tci_out);
+
+/**
+ * @brief Get the TPID of the outermost VLAN tag
+ *
+ * Uses the header cache when the VLAN stack is parsed.
+ *
+ * @param packet Packet buffer
+ * @return uint16_t ETHERTYPE_VLAN or ETHERTYPE_QINQ, or 0 if the frame is untagged
+ */
+uint16_t packet_vlan_tpid(const packet_buffer_t *packet);
+
+/**
+ * @brief Replace the TPID of the outermost VLAN tag in place
+ *
+ * @param packet Packet buffer
+ * @param tpid New tag protocol identifier (ETHERTYPE_VLAN or ETHERTYPE_QINQ)
+ * @return status_t STATUS_SUCCESS, or STATUS_NOT_FOUND if the frame is untagged
+ */
+status_t packet_vlan_set_tpid(packet_buffer_t *packet, uint16_t tpid);
+
+/**
+ * @brief Insert an 802.1ad S-tag and an 802.1Q C-tag in place
+ *
+ * @param packet Packet buffer
+ * @param s_tci Service tag control information (outer, ETHERTYPE_QINQ)
+ * @param c_tci Customer tag control information (inner, ETHERTYPE_VLAN)
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t packet_qinq_push(packet_buffer_t *packet, uint16_t s_tci, uint16_t c_tci);
+
+/**
+ * @brief Remove the two outermost VLAN tags in place
+ *
+ * @param packet Packet buffer
+ * @param[out] s_tci_out Removed outer tag control information (may be NULL)
+ * @param[out] c_tci_out Removed inner tag control information (may be NULL)
+ * @return status_t STATUS_SUCCESS, or STATUS_NOT_FOUND if the frame is not double tagged
+ */
+status_t packet_qinq_pop(packet_buffer_t *packet, uint16_t *s_tci_out, uint16_t *c_tci_out);
+
+/**
+ * @brief Replace the VID of the outermost VLAN tag in place
+ *
+ * PCP and DEI bits are kept.
+ *
+ * @param packet Packet buffer
+ * @param vlan_id New VLAN ID
+ * @return status_t STATUS_SUCCESS, or STATUS_NOT_FOUND if the frame is untagged
+ */
+status_t packet_vlan_set_vid(packet_buffer_t *packet, vlan_id_t vlan_id);
 
 /**
  * @brief Clone a packet buffer
@@ -259,6 +728,48 @@ status_t packet_update_data(packet_buffer_t *packet, uint32_t offset, const void
  */
 packet_buffer_t* packet_buffer_clone(const packet_buffer_t *packet);
 
+/**
+ * @brief Clone a packet buffer sharing its data
+ *
+ * The clone gets its own descriptor, metadata and data pointer but
+ * references the same payload. Data is copied only when either buffer is
+ * modified (see packet_make_writable()). The first shared clone of a buffer
+ * must be taken by the thread that owns it.
+ *
+ * @param packet Source packet buffer
+ * @return packet_buffer_t* Clone or NULL if failed
+ */
+packet_buffer_t* packet_buffer_clone_shared(const packet_buffer_t *packet);
+
+/**
+ * @brief Create a packet referencing a byte range of another packet
+ *
+ * The slice shares the source data the same way a shared clone does and
+ * may span several segments. Used to split and join packets (e.g. IP
+ * fragmentation and reassembly) without copying the payload.
+ *
+ * @param packet Source packet
+ * @param offset Start of the range
+ * @param length Number of bytes (at least 1)
+ * @return packet_buffer_t* Slice or NULL if failed
+ */
+packet_buffer_t* packet_buffer_slice(const packet_buffer_t *packet, uint32_t offset, uint32_t length);
+
+/**
+ * @brief Check whether packet data is shared with clones
+ */
+#define packet_is_shared(packet)    ((packet)->shared != NULL)
+
+/**
+ * @brief Give a packet buffer a private copy of its data if it is shared
+ *
+ * Called implicitly by all functions that modify packet data.
+ *
+ * @param packet Packet buffer
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t packet_make_writable(packet_buffer_t *packet);
+
 /**
  * @brief Resize packet buffer data section
  * 
@@ -282,6 +793,23 @@ status_t packet_register_processor(packet_process_cb_t callback,
                                   void *user_data, 
                                   uint32_t *handle_out);
 
+/**
+ * @brief Register a burst packet processing callback
+ *
+ * Burst processors share the priority order and handle space of
+ * per-packet processors. packet_process() calls them with a burst of one.
+ *
+ * @param callback Burst processing callback function
+ * @param priority Processing priority (lower numbers = higher priority)
+ * @param user_data User data to pass to callback
+ * @param[out] handle_out Handle for registered callback
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t packet_register_burst_processor(packet_burst_process_cb_t callback,
+                                         uint32_t priority,
+                                         void *user_data,
+                                         uint32_t *handle_out);
+
 /**
  * @brief Unregister a packet processing callback
  *
@@ -290,6 +818,17 @@ status_t packet_register_processor(packet_process_cb_t callback,
  */
 status_t packet_unregister_processor(uint32_t handle);
 
+/**
+ * @brief Name a registered processor for pipeline profiling reports
+ *
+ * Does nothing unless built with CONFIG_ENABLE_PIPELINE_PROFILING.
+ *
+ * @param handle Handle of registered callback
+ * @param name Stage name
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t packet_set_processor_name(uint32_t handle, const char *name);
+
 /**
  * @brief Process a packet through registered processors
  *
@@ -298,6 +837,20 @@ status_t packet_unregister_processor(uint32_t handle);
  */
 packet_result_t packet_process(packet_buffer_t *packet);
 
+/**
+ * @brief Process a burst of packets through registered processors
+ *
+ * Equivalent to calling packet_process() for every packet, but the
+ * processor list is fetched once per burst and burst processors see all
+ * packets that are still forwarded at their stage together.
+ *
+ * @param pkts Packets to process
+ * @param count Number of packets
+ * @param[out] results Final processing result for each packet
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t packet_process_burst(packet_buffer_t **pkts, uint32_t count, packet_result_t *results);
+
 /**
  * @brief Inject a packet into the switch processing pipeline
  *
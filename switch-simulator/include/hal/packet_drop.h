@@ -0,0 +1,153 @@
+/**
+ * @file packet_drop.h
+ * @brief Drop counters by reason and sampled drop capture
+ *
+ * Every place that discards a packet counts it under one reason of
+ * packet_drop_reason_t. The counters are one per-thread sharded set, so
+ * counting takes no lock. One drop in every packet_drop_get_sample_rate()
+ * of a thread is also copied, with its first bytes, into a capture ring
+ * that the CLI can dump.
+ *
+ * A packet is counted once: packet_drop_count() marks it with the reason
+ * and does nothing for a packet already marked. Pipeline stages that drop
+ * call it before returning PACKET_RESULT_DROP; packet_process() and
+ * packet_process_burst() count dropped packets nobody marked as
+ * PACKET_DROP_PIPELINE.
+ */
+
+#ifndef SWITCH_SIM_PACKET_DROP_H
+#define SWITCH_SIM_PACKET_DROP_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../common/config.h"
+#include "packet.h"
+
+/** Bytes of a dropped packet kept in its capture record */
+#define PACKET_DROP_CAPTURE_BYTES   64
+
+/**
+ * @brief Why a packet was dropped
+ */
+typedef enum {
+    PACKET_DROP_NONE = 0,           /**< Not dropped; never counted */
+    PACKET_DROP_PIPELINE,           /**< A stage returned DROP without a reason */
+    PACKET_DROP_INVALID,            /**< Invalid buffer or pipeline not ready */
+    PACKET_DROP_RECIRC_LIMIT,       /**< Recirculated too many times */
+    PACKET_DROP_PORT_DOWN,          /**< Ingress or egress port not up */
+    PACKET_DROP_RX_RING_FULL,       /**< Port RX ring full */
+    PACKET_DROP_DISPATCH_FULL,      /**< Forwarding worker inbox full */
+    PACKET_DROP_TX_RING_FULL,       /**< Port TX ring full */
+    PACKET_DROP_QOS_QUEUE,          /**< Egress queue tail drop or WRED */
+    PACKET_DROP_MTU_EXCEEDED,       /**< Larger than the egress port MTU */
+    PACKET_DROP_TX_OFFLOAD,         /**< TX offload work failed */
+    PACKET_DROP_TX_ERROR,           /**< Egress port refused the packet */
+    PACKET_DROP_VLAN_FILTER,        /**< VLAN ingress classification refused the frame */
+    PACKET_DROP_STP_BLOCKED,        /**< Port not forwarding in the spanning tree */
+    PACKET_DROP_STORM_CONTROL,      /**< Over the storm control rate */
+    PACKET_DROP_ACL_DENY,           /**< Denied by an ACL */
+    PACKET_DROP_IP_HEADER,          /**< Malformed or unsupported IP header */
+    PACKET_DROP_TTL_EXCEEDED,       /**< TTL or hop limit expired */
+    PACKET_DROP_NO_ROUTE,           /**< No route to the destination */
+    PACKET_DROP_FRAG_NEEDED,        /**< Too big for the MTU and may not be fragmented */
+    PACKET_DROP_FRAGMENT,           /**< Fragmentation or reassembly failed */
+    PACKET_DROP_NEIGHBOR,           /**< Next hop MAC address not resolved */
+    PACKET_DROP_PUNT,               /**< Refused by the local stack or its punt queue */
+    PACKET_DROP_INTERNAL,           /**< Resource or internal error */
+    PACKET_DROP_MPLS_LABEL,         /**< Label without an LFIB entry, reserved or a broken stack */
+    PACKET_DROP_POLICER,            /**< Over the rate of a policer */
+    PACKET_DROP_CONNTRACK,          /**< Connection table full or no NAT binding free */
+    PACKET_DROP_REASON_COUNT
+} packet_drop_reason_t;
+
+/**
+ * @brief Captured drop
+ */
+typedef struct {
+    uint64_t time_ns;               /**< CLOCK_MONOTONIC time of the drop */
+    uint8_t reason;                 /**< packet_drop_reason_t */
+    uint8_t direction;              /**< packet_direction_t */
+    port_id_t port;                 /**< Port in the metadata */
+    vlan_id_t vlan;                 /**< VLAN in the metadata */
+    uint32_t length;                /**< Length of the packet */
+    uint32_t captured;              /**< Bytes valid in data */
+    uint8_t data[PACKET_DROP_CAPTURE_BYTES];
+} packet_drop_record_t;
+
+/**
+ * @brief Create the counters and the capture ring; called by packet_init()
+ */
+status_t packet_drop_init(void);
+
+/**
+ * @brief Free the counters and the capture ring; called by packet_shutdown()
+ */
+void packet_drop_cleanup(void);
+
+/**
+ * @brief Count a dropped packet
+ *
+ * Marks the packet so it is not counted again and captures it if this is
+ * the sampled drop of the thread.
+ *
+ * @param packet Dropped packet, or NULL for drops of data already freed
+ * @param reason Why it was dropped
+ */
+void packet_drop_count(packet_buffer_t *packet, packet_drop_reason_t reason);
+
+/**
+ * @brief Count the packets of a burst from first on with one reason
+ *
+ * @param pkts Packets
+ * @param first Index of the first dropped packet
+ * @param count Number of packets in pkts
+ * @param reason Why they were dropped
+ */
+void packet_drop_count_burst(packet_buffer_t **pkts, uint32_t first, uint32_t count,
+                             packet_drop_reason_t reason);
+
+/**
+ * @brief Short name of a reason, as shown by the CLI
+ */
+const char *packet_drop_reason_name(packet_drop_reason_t reason);
+
+/**
+ * @brief Fold the counters over all threads
+ *
+ * @param[out] counts Drops by reason
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER or STATUS_NOT_INITIALIZED
+ */
+status_t packet_drop_get_counters(uint64_t counts[PACKET_DROP_REASON_COUNT]);
+
+/**
+ * @brief Clear the counters
+ */
+void packet_drop_clear_counters(void);
+
+/**
+ * @brief Capture one drop in every rate of each thread
+ *
+ * @param rate Sampling rate, 1 captures all drops, 0 none
+ */
+void packet_drop_set_sample_rate(uint32_t rate);
+
+/**
+ * @brief Current sampling rate, 0 if capture is off
+ */
+uint32_t packet_drop_get_sample_rate(void);
+
+/**
+ * @brief Copy the newest captured drops, oldest first
+ *
+ * @param[out] records Output array
+ * @param max Size of records
+ * @return Number of records copied
+ */
+uint32_t packet_drop_read_capture(packet_drop_record_t *records, uint32_t max);
+
+/**
+ * @brief Empty the capture ring
+ */
+void packet_drop_clear_capture(void);
+
+#endif /* SWITCH_SIM_PACKET_DROP_H */
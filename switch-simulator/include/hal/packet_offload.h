@@ -0,0 +1,87 @@
+/**
+ * @file packet_offload.h
+ * @brief Checksum and TCP segmentation offload for switch simulator
+ *
+ * The stack leaves checksums and TCP segmentation to the egress driver
+ * when it advertises DRIVER_FLAG_TX_CSUM or DRIVER_FLAG_TSO, marking the
+ * deferred work in packet_metadata_t.offload. The functions here are the
+ * two ends of that contract: the software fallback for work a port cannot
+ * take, and the emulated NIC that finishes frames on the simulated wire
+ * and checks them on reception.
+ *
+ * Frames are Ethernet frames with their headers in the first segment;
+ * payloads may be chained.
+ */
+
+#ifndef SWITCH_SIM_PACKET_OFFLOAD_H
+#define SWITCH_SIM_PACKET_OFFLOAD_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "packet.h"
+
+/** Most segments one TSO frame is cut into */
+#define PACKET_TSO_MAX_SEGS 64
+
+/**
+ * @brief Add bytes to a ones' complement sum
+ *
+ * @param sum Running sum
+ * @param data Bytes, summed as big-endian words
+ * @param len Number of bytes; an odd tail is padded with zero
+ * @return New running sum, not folded
+ */
+uint32_t packet_csum_add(uint32_t sum, const void *data, uint32_t len);
+
+/**
+ * @brief Fold a ones' complement sum into a checksum field value
+ *
+ * @param sum Running sum
+ * @return Checksum in host order
+ */
+uint16_t packet_csum_fold(uint32_t sum);
+
+/**
+ * @brief Do in software the deferred TX work a driver cannot take
+ *
+ * Fills in the checksums the driver would not and clears their flags.
+ * TSO is not done here; without DRIVER_FLAG_TSO a TSO frame is refused.
+ *
+ * @param packet Frame
+ * @param driver_flags Offload flags of the egress driver
+ * @return STATUS_SUCCESS on success, STATUS_NOT_SUPPORTED for a TSO frame
+ *         the driver cannot segment, STATUS_INVALID_PACKET if the headers
+ *         are not there
+ */
+status_t packet_offload_resolve(packet_buffer_t *packet, uint32_t driver_flags);
+
+/**
+ * @brief Finish a frame on transmission, as a NIC would
+ *
+ * Deferred checksums are filled in place. A TSO frame is cut into new
+ * segment frames with their own headers and checksums, sharing the
+ * payload of the original; the original is then not sent.
+ *
+ * @param packet Frame
+ * @param[out] segs Segments of a TSO frame, owned by the caller
+ * @param max Size of segs
+ * @param[out] count Number of segments, 0 if packet itself is to be sent
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PACKET if the headers
+ *         are not there, STATUS_RESOURCE_EXCEEDED if segs is too small,
+ *         STATUS_NO_MEMORY
+ */
+status_t packet_offload_tx(packet_buffer_t *packet, packet_buffer_t **segs, uint32_t max,
+                           uint32_t *count);
+
+/**
+ * @brief Check the checksums of a received frame, as a NIC would
+ *
+ * Sets PACKET_OFFLOAD_RX_IP_GOOD and PACKET_OFFLOAD_RX_L4_GOOD for the
+ * checksums found right and PACKET_OFFLOAD_RX_BAD if one is wrong.
+ * Fragments and other transports get no L4 verdict.
+ *
+ * @param packet Received frame
+ */
+void packet_offload_rx(packet_buffer_t *packet);
+
+#endif /* SWITCH_SIM_PACKET_OFFLOAD_H */
@@ -0,0 +1,262 @@
+/**
+ * @file packet_profile.h
+ * @brief Pipeline latency histograms for packet processors
+ *
+ * Built only with CONFIG_ENABLE_PIPELINE_PROFILING. packet_process() and
+ * packet_process_burst() then time every processor call in TSC cycles,
+ * and the TX drain times how long each packet spent between being queued
+ * on an RX ring and leaving through a TX ring. Every worker thread counts
+ * into its own shard of the histograms, so recording takes no lock;
+ * readers fold the shards.
+ *
+ * Histograms are log-linear: values below 2^PACKET_PROFILE_SUB_BITS have
+ * one bucket each, and every power of two above is split into
+ * 2^PACKET_PROFILE_SUB_BITS equal buckets, which keeps the relative error
+ * of a percentile under 1 / 2^PACKET_PROFILE_SUB_BITS.
+ *
+ * With packet_profile_set_counters() every stage call is also bracketed by
+ * reads of the thread's hardware counters (common/perf_counters.h), which
+ * attributes cycles, instructions and cache, branch and TLB misses to the
+ * stages. That costs two system calls per call, so it is off by default.
+ */
+
+#ifndef SWITCH_SIM_PACKET_PROFILE_H
+#define SWITCH_SIM_PACKET_PROFILE_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../common/config.h"
+
+#if CONFIG_ENABLE_PIPELINE_PROFILING
+
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "../common/stats_shard.h"
+#include "../common/perf_counters.h"
+
+/** Stage histograms, one per processor handle */
+#define PACKET_PROFILE_STAGES       64
+
+/** Histogram of the RX ring to TX ring residency, after the stages */
+#define PACKET_PROFILE_RESIDENCY    PACKET_PROFILE_STAGES
+
+#define PACKET_PROFILE_HISTOGRAMS   (PACKET_PROFILE_STAGES + 1)
+
+/** Buckets per power of two, as a shift */
+#define PACKET_PROFILE_SUB_BITS     2
+
+/** Values from 2^PACKET_PROFILE_MAX_BITS up share the last bucket */
+#define PACKET_PROFILE_MAX_BITS     40
+
+#define PACKET_PROFILE_BUCKETS \
+    ((PACKET_PROFILE_MAX_BITS - PACKET_PROFILE_SUB_BITS + 1) << PACKET_PROFILE_SUB_BITS)
+
+/** Counters of one histogram in the shard set: count, total, buckets, hardware events */
+#define PACKET_PROFILE_WORDS        (2 + PACKET_PROFILE_BUCKETS + PERF_COUNTER_COUNT)
+
+/** Longest stage name kept */
+#define PACKET_PROFILE_NAME_MAX     32
+
+/**
+ * @brief Folded histogram
+ */
+typedef struct {
+    uint64_t count;                             /**< Samples */
+    uint64_t total;                             /**< Sum of the samples, in cycles */
+    uint64_t buckets[PACKET_PROFILE_BUCKETS];   /**< Samples per bucket */
+    uint64_t events[PERF_COUNTER_COUNT];        /**< Hardware events, by perf_counter_t, if counted */
+} packet_profile_hist_t;
+
+/** Histogram shards; NULL outside packet_init()/packet_shutdown() */
+extern stats_shard_set_t *g_packet_profile;
+
+/** Whether stage calls are bracketed by hardware counter reads */
+extern bool g_packet_profile_counters;
+
+/**
+ * @brief Read the cycle counter
+ *
+ * The TSC where there is one, monotonic nanoseconds elsewhere.
+ */
+static inline uint64_t packet_profile_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Bucket of a value
+ */
+static inline uint32_t packet_profile_bucket(uint64_t value) {
+    uint32_t bits;
+
+    if (value < (1u << PACKET_PROFILE_SUB_BITS)) {
+        return (uint32_t)value;
+    }
+    bits = 63 - (uint32_t)__builtin_clzll(value);
+    if (bits >= PACKET_PROFILE_MAX_BITS) {
+        return PACKET_PROFILE_BUCKETS - 1;
+    }
+    // Power of two above the linear range, then the next SUB_BITS bits below the top one
+    return ((bits - PACKET_PROFILE_SUB_BITS + 1) << PACKET_PROFILE_SUB_BITS) |
+           (uint32_t)((value >> (bits - PACKET_PROFILE_SUB_BITS)) & ((1u << PACKET_PROFILE_SUB_BITS) - 1));
+}
+
+/**
+ * @brief Smallest value of a bucket
+ */
+static inline uint64_t packet_profile_bucket_floor(uint32_t bucket) {
+    uint32_t group = bucket >> PACKET_PROFILE_SUB_BITS;
+    uint64_t sub = bucket & ((1u << PACKET_PROFILE_SUB_BITS) - 1);
+
+    if (group == 0) {
+        return sub;
+    }
+    return ((1ULL << PACKET_PROFILE_SUB_BITS) | sub) << (group - 1);
+}
+
+/**
+ * @brief Add samples to a histogram of the calling thread
+ *
+ * A burst stage is timed once per call; each of its packets is counted
+ * with the average.
+ *
+ * @param hist Processor handle or PACKET_PROFILE_RESIDENCY
+ * @param cycles Time taken for all the packets
+ * @param packets Packets handled in that time
+ */
+static inline void packet_profile_record(uint32_t hist, uint64_t cycles, uint32_t packets) {
+    stats_shard_set_t *set = __atomic_load_n(&g_packet_profile, __ATOMIC_RELAXED);
+    uint64_t *words;
+
+    if (!set || hist >= PACKET_PROFILE_HISTOGRAMS || packets == 0) {
+        return;
+    }
+    words = stats_shard_local(set) + (size_t)hist * PACKET_PROFILE_WORDS;
+    stats_shard_add(&words[0], packets);
+    stats_shard_add(&words[1], cycles);
+    stats_shard_add(&words[2 + packet_profile_bucket(cycles / packets)], packets);
+}
+
+/**
+ * @brief Read the hardware counters of the calling thread before a stage call
+ *
+ * @param[out] start Counts before the call
+ * @return Counter group to hand to packet_profile_counters_end(), NULL if
+ *         counting is off or the thread has no counters
+ */
+static inline perf_counters_t *packet_profile_counters_begin(perf_sample_t *start) {
+    perf_counters_t *pc;
+
+    if (!__atomic_load_n(&g_packet_profile_counters, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    pc = perf_counters_thread();
+    if (!pc || perf_counters_read(pc, start) != STATUS_SUCCESS) {
+        return NULL;
+    }
+    return pc;
+}
+
+/**
+ * @brief Add the hardware events of a stage call to its histogram
+ *
+ * @param pc Group from packet_profile_counters_begin(), may be NULL
+ * @param hist Processor handle
+ * @param start Counts before the call
+ */
+static inline void packet_profile_counters_end(perf_counters_t *pc, uint32_t hist, const perf_sample_t *start) {
+    stats_shard_set_t *set = __atomic_load_n(&g_packet_profile, __ATOMIC_RELAXED);
+    perf_sample_t end;
+    perf_sample_t delta;
+    uint64_t *words;
+
+    if (!pc || !set || hist >= PACKET_PROFILE_HISTOGRAMS || perf_counters_read(pc, &end) != STATUS_SUCCESS) {
+        return;
+    }
+    perf_sample_delta(start, &end, &delta);
+    words = stats_shard_local(set) + (size_t)hist * PACKET_PROFILE_WORDS + 2 + PACKET_PROFILE_BUCKETS;
+    for (uint32_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+        stats_shard_add(&words[i], delta.values[i]);
+    }
+}
+
+/**
+ * @brief Create the histograms; called by packet_init()
+ */
+status_t packet_profile_init(void);
+
+/**
+ * @brief Free the histograms; called by packet_shutdown()
+ */
+void packet_profile_cleanup(void);
+
+/**
+ * @brief Name the stage of a processor handle in reports
+ *
+ * @param handle Processor handle
+ * @param name Name, NULL to clear
+ * @return STATUS_SUCCESS or STATUS_INVALID_PARAMETER
+ */
+status_t packet_profile_set_name(uint32_t handle, const char *name);
+
+/**
+ * @brief Fold one histogram over all worker threads
+ *
+ * @param hist Processor handle or PACKET_PROFILE_RESIDENCY
+ * @param[out] out Folded histogram
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER or STATUS_NOT_INITIALIZED
+ */
+status_t packet_profile_get(uint32_t hist, packet_profile_hist_t *out);
+
+/**
+ * @brief Value at a percentile, as the floor of its bucket
+ *
+ * @param hist Folded histogram
+ * @param percentile 0 to 100
+ * @return Cycles, 0 for an empty histogram
+ */
+uint64_t packet_profile_percentile(const packet_profile_hist_t *hist, double percentile);
+
+/**
+ * @brief Cycles of packet_profile_now() per microsecond, measured since packet_init()
+ */
+double packet_profile_cycles_per_us(void);
+
+/**
+ * @brief Clear one histogram, or all with PACKET_PROFILE_HISTOGRAMS
+ */
+void packet_profile_clear(uint32_t hist);
+
+/**
+ * @brief Turn the hardware counters around stage calls on or off
+ *
+ * @param enable True to count
+ * @return STATUS_SUCCESS, or STATUS_NOT_SUPPORTED when enabling on a
+ *         system without counters
+ */
+status_t packet_profile_set_counters(bool enable);
+
+/**
+ * @brief Write a table of every histogram with samples
+ *
+ * Stages with hardware event counts get a second table: instructions per
+ * cycle, events per packet and whether the stage looks memory-bound.
+ *
+ * @param buf Output buffer
+ * @param len Size of buf
+ * @return Length of the report, which is truncated if not less than len
+ */
+size_t packet_profile_report(char *buf, size_t len);
+
+#endif /* CONFIG_ENABLE_PIPELINE_PROFILING */
+
+#endif /* SWITCH_SIM_PACKET_PROFILE_H */
@@ -0,0 +1,201 @@
+/**
+ * @file packet_ring.h
+ * @brief Single-producer/single-consumer packet ring for switch simulator
+ *
+ * Rings pass packet buffer pointers between exactly one producer thread
+ * and one consumer thread without locks. Producer and consumer indices
+ * live on separate cache lines; each side keeps a cached copy of the
+ * other index and reloads it only when the ring looks full (or empty).
+ */
+
+#ifndef SWITCH_SIM_PACKET_RING_H
+#define SWITCH_SIM_PACKET_RING_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/types.h"
+#include "packet.h"
+
+#define PACKET_RING_CACHE_LINE  64
+
+/**
+ * @brief Packet ring
+ */
+typedef struct {
+    /* Read-only after creation */
+    uint32_t size;              /**< Number of slots (power of two) */
+    uint32_t mask;              /**< size - 1 */
+
+    /* Producer side */
+    volatile uint32_t head __attribute__((aligned(PACKET_RING_CACHE_LINE)));
+    uint32_t tail_cache;        /**< Producer's last view of tail */
+    uint64_t enqueued;          /**< Packets added */
+    uint64_t full_drops;        /**< Packets refused because the ring was full */
+
+    /* Consumer side */
+    volatile uint32_t tail __attribute__((aligned(PACKET_RING_CACHE_LINE)));
+    uint32_t head_cache;        /**< Consumer's last view of head */
+    uint64_t dequeued;          /**< Packets taken */
+
+    packet_buffer_t *slots[] __attribute__((aligned(PACKET_RING_CACHE_LINE)));
+} packet_ring_t;
+
+/**
+ * @brief Memory of a ring of size slots, e.g. for placing it on a NUMA node
+ *
+ * @param size Number of slots
+ * @return Bytes
+ */
+static inline size_t packet_ring_bytes(uint32_t size) {
+    return sizeof(packet_ring_t) + (size_t)size * sizeof(packet_buffer_t *);
+}
+
+/**
+ * @brief Allocate an empty packet ring
+ *
+ * @param size Number of slots, must be a power of two
+ * @return New ring, or NULL on invalid size or allocation failure
+ */
+static inline packet_ring_t *packet_ring_create(uint32_t size) {
+    packet_ring_t *ring = NULL;
+    size_t bytes = packet_ring_bytes(size);
+
+    if (size == 0 || (size & (size - 1)) != 0) {
+        return NULL;
+    }
+    if (posix_memalign((void **)&ring, PACKET_RING_CACHE_LINE, bytes) != 0) {
+        return NULL;
+    }
+    memset(ring, 0, bytes);
+    ring->size = size;
+    ring->mask = size - 1;
+    return ring;
+}
+
+/**
+ * @brief Count packets refused for lack of room (producer side only)
+ *
+ * For producers that size their enqueue with packet_ring_room().
+ *
+ * @param ring Packet ring
+ * @param n Packets refused
+ */
+static inline void packet_ring_count_full(packet_ring_t *ring, uint32_t n) {
+    if (n) {
+        __atomic_store_n(&ring->full_drops, ring->full_drops + n, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Add up to count packets to a ring (producer side only)
+ *
+ * @param ring Packet ring
+ * @param pkts Packets to add
+ * @param count Number of packets
+ * @return Number of packets added (a prefix of pkts); the rest are
+ *         counted as ring-full drops and stay with the caller
+ */
+static inline uint32_t packet_ring_enqueue_burst(packet_ring_t *ring, packet_buffer_t **pkts,
+                                                 uint32_t count) {
+    uint32_t head = ring->head;
+    uint32_t space = ring->size - (head - ring->tail_cache);
+
+    if (space < count) {
+        ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        space = ring->size - (head - ring->tail_cache);
+    }
+
+    uint32_t n = count < space ? count : space;
+    for (uint32_t i = 0; i < n; i++) {
+        ring->slots[(head + i) & ring->mask] = pkts[i];
+    }
+
+    /* Publish the slots before the new head */
+    __atomic_store_n(&ring->head, head + n, __ATOMIC_RELEASE);
+
+    /* Counters have one writer each and are read from other threads */
+    __atomic_store_n(&ring->enqueued, ring->enqueued + n, __ATOMIC_RELAXED);
+    packet_ring_count_full(ring, count - n);
+    return n;
+}
+
+/**
+ * @brief Free slots a following enqueue is sure to get (producer side only)
+ *
+ * The consumer only ever frees more slots, so the room can grow but not
+ * shrink before the producer's next enqueue.
+ *
+ * @param ring Packet ring
+ * @return Free slots
+ */
+static inline uint32_t packet_ring_room(packet_ring_t *ring) {
+    ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    return ring->size - (ring->head - ring->tail_cache);
+}
+
+/**
+ * @brief Take up to max packets from a ring (consumer side only)
+ *
+ * @param ring Packet ring
+ * @param pkts Output array for the packets
+ * @param max Maximum number of packets to take
+ * @return Number of packets taken
+ */
+static inline uint32_t packet_ring_dequeue_burst(packet_ring_t *ring, packet_buffer_t **pkts,
+                                                 uint32_t max) {
+    uint32_t tail = ring->tail;
+    uint32_t avail = ring->head_cache - tail;
+
+    if (avail < max) {
+        ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        avail = ring->head_cache - tail;
+    }
+
+    uint32_t n = max < avail ? max : avail;
+    for (uint32_t i = 0; i < n; i++) {
+        pkts[i] = ring->slots[(tail + i) & ring->mask];
+    }
+
+    /* Release the slots back to the producer */
+    __atomic_store_n(&ring->tail, tail + n, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&ring->dequeued, ring->dequeued + n, __ATOMIC_RELAXED);
+    return n;
+}
+
+/**
+ * @brief Number of packets currently queued (approximate from other threads)
+ *
+ * @param ring Packet ring
+ * @return Queued packet count
+ */
+static inline uint32_t packet_ring_count(const packet_ring_t *ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Free a packet ring and the packets still queued on it
+ *
+ * Must not race with either side of the ring.
+ *
+ * @param ring Ring to free (may be NULL)
+ */
+static inline void packet_ring_destroy(packet_ring_t *ring) {
+    packet_buffer_t *pkts[PACKET_BURST_MAX];
+    uint32_t n;
+
+    if (!ring) {
+        return;
+    }
+
+    while ((n = packet_ring_dequeue_burst(ring, pkts, PACKET_BURST_MAX)) > 0) {
+        for (uint32_t i = 0; i < n; i++) {
+            packet_buffer_free(pkts[i]);
+        }
+    }
+    free(ring);
+}
+
+#endif /* SWITCH_SIM_PACKET_RING_H */
@@ -0,0 +1,201 @@
+/**
+ * @file policer.h
+ * @brief Single-rate and two-rate three-color markers (RFC 2697, RFC 2698)
+ *
+ * A policer meters the frames charged to it and colors each one green,
+ * yellow or red. The single-rate marker (srTCM) has a committed bucket
+ * of CBS bytes and an excess bucket of EBS bytes, both filled at CIR, the
+ * excess one only with what overflows the committed one. The two-rate
+ * marker (trTCM) has a committed bucket of CBS bytes filled at CIR and a
+ * peak bucket of PBS bytes filled at PIR. Either runs color-blind, or
+ * color-aware, when a frame can only keep or lose the color an earlier
+ * policer gave it. Each color is forwarded or dropped as configured, and
+ * the color a frame leaves with is in its metadata.
+ *
+ * Policers are numbered 1 to CONFIG_MAX_POLICERS and attached by number
+ * to the ingress or egress side of a port, to the ingress of a VLAN, and
+ * to ACL rules (acl.h). Ingress port and VLAN policing is a burst stage
+ * of the packet pipeline at POLICER_PROCESSOR_PRIORITY, after mirroring
+ * and sampling, so those see traffic before it is policed; egress
+ * policing runs as frames are queued for transmission.
+ *
+ * Buckets are shared by every forwarding worker and kept in units of a
+ * billionth of a byte, so refilling at any rate is exact. Frames take
+ * tokens with one atomic fetch-and-subtract per bucket, and the bucket
+ * is refilled by whichever worker wins a compare-and-swap of the refill
+ * time; no worker ever waits for another.
+ */
+#ifndef SWITCH_SIM_POLICER_H
+#define SWITCH_SIM_POLICER_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../common/config.h"
+#include "packet.h"
+
+#define POLICER_PROCESSOR_PRIORITY  120             /**< Pipeline priority of the ingress stage */
+#define POLICER_NONE                0               /**< Policer number meaning none */
+#define POLICER_MAX_RATE            100000000000ULL /**< Highest rate, bytes per second (800 Gbps) */
+#define POLICER_MAX_BURST           (1ULL << 30)    /**< Deepest bucket, bytes */
+
+/**
+ * @brief Marker algorithm
+ */
+typedef enum {
+    POLICER_MODE_SRTCM = 0,         /**< RFC 2697: CIR, CBS and EBS */
+    POLICER_MODE_TRTCM              /**< RFC 2698: CIR, CBS, PIR and PBS */
+} policer_mode_t;
+
+/**
+ * @brief Color of a metered frame
+ */
+typedef enum {
+    POLICER_COLOR_GREEN = 0,
+    POLICER_COLOR_YELLOW,
+    POLICER_COLOR_RED
+} policer_color_t;
+
+/**
+ * @brief What happens to a frame of a color
+ */
+typedef enum {
+    POLICER_ACTION_FORWARD = 0,     /**< Forward, marked with the color */
+    POLICER_ACTION_DROP             /**< Drop */
+} policer_action_t;
+
+/**
+ * @brief Policer configuration
+ *
+ * A committed or peak burst of 0 defaults to 10 ms at the bucket's rate,
+ * and at least one full-sized Ethernet frame.
+ */
+typedef struct {
+    policer_mode_t mode;
+    bool color_aware;               /**< Frames keep or lose the color they arrive with */
+    uint64_t cir;                   /**< Committed rate, bytes per second */
+    uint64_t cbs;                   /**< Committed burst, bytes */
+    uint64_t ebs;                   /**< srTCM excess burst, bytes; 0 means no yellow */
+    uint64_t pir;                   /**< trTCM peak rate, bytes per second, at least cir */
+    uint64_t pbs;                   /**< trTCM peak burst, bytes */
+    policer_action_t yellow_action; /**< Usually POLICER_ACTION_FORWARD */
+    policer_action_t red_action;    /**< Usually POLICER_ACTION_DROP */
+} policer_config_t;
+
+/**
+ * @brief Counters of one policer, summed over all forwarding threads
+ */
+typedef struct {
+    uint64_t green_packets;
+    uint64_t green_bytes;
+    uint64_t yellow_packets;
+    uint64_t yellow_bytes;
+    uint64_t red_packets;
+    uint64_t red_bytes;
+    uint64_t dropped_packets;       /**< Frames dropped for their color */
+} policer_stats_t;
+
+/**
+ * @brief Initialize policing with no policer and register the ingress stage
+ *
+ * @return STATUS_SUCCESS on success, STATUS_ALREADY_INITIALIZED,
+ *         STATUS_NO_MEMORY, or the error of the stage registration
+ */
+status_t policer_init(void);
+
+/**
+ * @brief Unregister the ingress stage and free every policer
+ *
+ * Must not run concurrently with packet processing.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t policer_cleanup(void);
+
+/**
+ * @brief Create a policer or change its configuration
+ *
+ * A changed policer starts with full buckets. Counters are kept.
+ *
+ * @param policer_id Policer, 1 to CONFIG_MAX_POLICERS
+ * @param config Configuration
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t policer_set(uint32_t policer_id, const policer_config_t *config);
+
+/**
+ * @brief Delete a policer
+ *
+ * Attachments stay; they meter nothing until the policer is set again.
+ *
+ * @param policer_id Policer
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_NOT_FOUND
+ */
+status_t policer_delete(uint32_t policer_id);
+
+/**
+ * @brief Attach a policer to a port
+ *
+ * @param port_id Port
+ * @param direction PACKET_DIR_RX for ingress, PACKET_DIR_TX for egress
+ * @param policer_id Policer, POLICER_NONE to detach
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t policer_attach_port(port_id_t port_id, packet_direction_t direction, uint32_t policer_id);
+
+/**
+ * @brief Attach a policer to the ingress of a VLAN
+ *
+ * Frames are charged to the VLAN in their metadata. A frame is charged to
+ * its port's policer first, and only one that passes that is charged to
+ * the VLAN's.
+ *
+ * @param vlan_id VLAN
+ * @param policer_id Policer, POLICER_NONE to detach
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t policer_attach_vlan(vlan_id_t vlan_id, uint32_t policer_id);
+
+/**
+ * @brief Meter a frame and apply the action of its color
+ *
+ * Lock-free. The frame's metadata color is set; a frame that is dropped
+ * is counted as a PACKET_DROP_POLICER drop. Frames charged to no
+ * configured policer pass unmetered.
+ *
+ * @param policer_id Policer
+ * @param packet Frame
+ * @return true if the frame may continue
+ */
+bool policer_police(uint32_t policer_id, packet_buffer_t *packet);
+
+/**
+ * @brief Police a burst against the egress policer of a port
+ *
+ * pkts is reordered so that the frames that pass come first, in their
+ * order, followed by the dropped ones, which the caller still owns.
+ *
+ * @param port_id Egress port
+ * @param pkts Frames
+ * @param count Number of frames
+ * @return Number of frames that pass
+ */
+uint32_t policer_egress_burst(port_id_t port_id, packet_buffer_t **pkts, uint32_t count);
+
+/**
+ * @brief Get the counters of a policer
+ *
+ * @param policer_id Policer
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t policer_get_stats(uint32_t policer_id, policer_stats_t *stats);
+
+/**
+ * @brief Clear the counters of a policer
+ *
+ * @param policer_id Policer
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t policer_clear_stats(uint32_t policer_id);
+
+#endif /* SWITCH_SIM_POLICER_H */
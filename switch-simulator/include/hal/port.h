@@ -275,11 +275,35 @@ bool port_is_valid(port_id_t port_id);
 /**
  * @brief Check if a port is operationally up
  *
+ * Lock-free, from the transmit fast path descriptor of the port.
+ *
  * @param port_id Port identifier
  * @return true if port is up, false otherwise
  */
 bool port_is_up(port_id_t port_id);
 
+/**
+ * @brief Get the MTU of a port
+ *
+ * Lock-free, from the transmit fast path descriptor of the port.
+ *
+ * @param port_id Port identifier
+ * @return MTU in bytes, 0 for an invalid port
+ */
+uint32_t port_get_mtu(port_id_t port_id);
+
+/**
+ * @brief Publish the state, MTU, driver and offloads of a port to the transmit fast path
+ *
+ * Called by the hardware simulation, under the port lock, whenever one of
+ * them changes. Senders read the published copy without locks.
+ *
+ * @param port_id Port identifier
+ * @param info Current port information
+ * @param offloads DRIVER_FLAGS_OFFLOAD of the port
+ */
+void port_fast_path_update(port_id_t port_id, const port_info_t *info, uint32_t offloads);
+
 /**
  * @brief Get port operational state
  *
@@ -320,6 +344,20 @@ status_t port_receive_packet(port_id_t port_id, packet_t *packet);
  */
 status_t port_send_packet(port_id_t port_id, packet_t *packet);
 
+/**
+ * @brief Send a burst of packets out of a port
+ *
+ * The port is checked and its counters updated once for the burst, which
+ * goes to the driver's transmit_burst op. The packets stay with the caller.
+ *
+ * @param port_id Port identifier to send the packets out of
+ * @param pkts Packets to send
+ * @param count Number of packets
+ * @param[out] sent Packets sent, a prefix of pkts; may be NULL
+ * @return STATUS_SUCCESS if every packet was sent, error code otherwise
+ */
+status_t port_send_burst(port_id_t port_id, packet_t **pkts, uint16_t count, uint16_t *sent);
+
 /**
  * @brief Send a packet with specific MAC addresses and ethertype
  *
@@ -0,0 +1,197 @@
+/**
+ * @file qos.h
+ * @brief Per-port egress queues and scheduler
+ *
+ * A port with QoS enabled holds its outgoing packets in eight queues
+ * instead of handing them straight to the TX ring. Packets are classified
+ * by their 802.1p priority (metadata.priority) or by the DSCP of their IP
+ * header, and each queue limits its depth by tail drop and optionally by
+ * WRED. The scheduler serves strict-priority queues first, highest queue
+ * number first, and shares what is left between the DWRR queues in
+ * proportion to their weights, counted in bytes.
+ *
+ * Forwarding workers add whole bursts with qos_enqueue_burst() and the
+ * port's transmit side takes bursts with qos_dequeue_burst(); each call
+ * takes the port lock once.
+ */
+#ifndef SWITCH_SIM_QOS_H
+#define SWITCH_SIM_QOS_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "packet.h"
+
+#define QOS_QUEUES_PER_PORT         8       /**< Egress queues of a port */
+#define QOS_QUEUE_CAPACITY          2048    /**< Largest queue limit, in packets */
+#define QOS_QUEUE_LIMIT_DEFAULT     1024    /**< Default queue limit, in packets */
+#define QOS_DWRR_QUANTUM_BYTES      2048    /**< Bytes one unit of DWRR weight earns per round */
+#define QOS_WRED_EWMA_SHIFT         9       /**< WRED average weight is 2^-shift */
+
+/**
+ * @brief Which header field selects the queue
+ */
+typedef enum {
+    QOS_TRUST_PCP = 0,              /**< 802.1p priority from metadata.priority */
+    QOS_TRUST_DSCP                  /**< IP DSCP; non-IP frames fall back to the priority */
+} qos_trust_t;
+
+/**
+ * @brief How a queue is scheduled
+ */
+typedef enum {
+    QOS_SCHED_STRICT = 0,           /**< Served before all DWRR queues, higher queue first */
+    QOS_SCHED_DWRR                  /**< Shares the remaining bandwidth by weight */
+} qos_sched_t;
+
+/**
+ * @brief WRED profile of a queue
+ *
+ * Thresholds apply to the average depth in packets. Below min_threshold
+ * nothing is dropped, at or above max_threshold everything is, and in
+ * between the drop probability rises linearly to max_drop_percent.
+ */
+typedef struct {
+    bool enabled;                   /**< Whether WRED is applied */
+    uint32_t min_threshold;         /**< Average depth where drops start */
+    uint32_t max_threshold;         /**< Average depth where every packet is dropped */
+    uint8_t max_drop_percent;       /**< Drop probability just below max_threshold (1..100) */
+} qos_wred_t;
+
+/**
+ * @brief Configuration of one egress queue
+ */
+typedef struct {
+    qos_sched_t sched;              /**< Scheduling discipline */
+    uint32_t weight;                /**< DWRR weight (1..255), ignored for strict queues */
+    uint32_t limit;                 /**< Tail-drop depth in packets (1..QOS_QUEUE_CAPACITY) */
+    qos_wred_t wred;                /**< Early drop profile */
+} qos_queue_config_t;
+
+/**
+ * @brief QoS configuration of a port
+ */
+typedef struct {
+    qos_trust_t trust;                              /**< Classification source */
+    uint8_t pcp_to_queue[8];                        /**< Queue for each 802.1p priority */
+    uint8_t dscp_to_queue[64];                      /**< Queue for each DSCP */
+    qos_queue_config_t queues[QOS_QUEUES_PER_PORT]; /**< Per-queue settings */
+} qos_port_config_t;
+
+/**
+ * @brief Counters of one egress queue
+ */
+typedef struct {
+    uint64_t enqueued;              /**< Packets accepted */
+    uint64_t enqueued_bytes;        /**< Bytes accepted */
+    uint64_t dequeued;              /**< Packets handed to the port */
+    uint64_t dequeued_bytes;        /**< Bytes handed to the port */
+    uint64_t tail_drops;            /**< Packets refused because the queue was at its limit */
+    uint64_t wred_drops;            /**< Packets refused by WRED */
+    uint32_t depth;                 /**< Packets queued now */
+    uint32_t max_depth;             /**< Deepest the queue has been */
+    uint32_t avg_depth;             /**< WRED average depth in packets */
+} qos_queue_stats_t;
+
+/**
+ * @brief Initialize QoS with every port sending straight to its TX ring
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t qos_init(void);
+
+/**
+ * @brief Free all queues and the packets still in them
+ *
+ * Must not run concurrently with enqueue or dequeue.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t qos_shutdown(void);
+
+/**
+ * @brief Fill a configuration with the defaults
+ *
+ * Queue 7 is strict, queues 0-6 are DWRR with weight queue + 1. Priorities
+ * map to the queue of the same number and DSCPs to their class selector.
+ * Every queue holds QOS_QUEUE_LIMIT_DEFAULT packets without WRED.
+ *
+ * @param[out] config Configuration to fill
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER if config is NULL
+ */
+status_t qos_get_default_config(qos_port_config_t *config);
+
+/**
+ * @brief Enable egress queueing on a port, or change its configuration
+ *
+ * Packets already queued stay where they are.
+ *
+ * @param port_id Egress port
+ * @param config Port configuration
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER for a bad
+ *         configuration, STATUS_NO_MEMORY, STATUS_NOT_SUPPORTED if QoS
+ *         is compiled out
+ */
+status_t qos_port_enable(port_id_t port_id, const qos_port_config_t *config);
+
+/**
+ * @brief Disable egress queueing on a port and drop what it holds
+ *
+ * @param port_id Egress port
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t qos_port_disable(port_id_t port_id);
+
+/**
+ * @brief Check whether a port queues its egress traffic
+ *
+ * @param port_id Egress port
+ * @return true if QoS is enabled on the port
+ */
+bool qos_port_enabled(port_id_t port_id);
+
+/**
+ * @brief Classify and queue a burst of packets
+ *
+ * pkts is reordered so that the queued packets come first; the queues own
+ * those and the caller keeps the refused ones that follow.
+ *
+ * @param port_id Egress port
+ * @param pkts Packets to queue
+ * @param count Number of packets
+ * @param[out] queued Number of packets queued
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if QoS is not
+ *         enabled on the port (nothing is taken)
+ */
+status_t qos_enqueue_burst(port_id_t port_id, packet_buffer_t **pkts, uint32_t count,
+                           uint32_t *queued);
+
+/**
+ * @brief Take the next packets to send from a port's queues
+ *
+ * @param port_id Egress port
+ * @param pkts Output array; the caller owns the packets
+ * @param max Maximum number of packets to take
+ * @return Number of packets taken, 0 if the queues are empty or QoS is off
+ */
+uint32_t qos_dequeue_burst(port_id_t port_id, packet_buffer_t **pkts, uint32_t max);
+
+/**
+ * @brief Get the counters of one egress queue
+ *
+ * @param port_id Egress port
+ * @param queue_id Queue number (below QOS_QUEUES_PER_PORT)
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t qos_get_queue_stats(port_id_t port_id, uint8_t queue_id, qos_queue_stats_t *stats);
+
+/**
+ * @brief Reset the counters of one egress queue
+ *
+ * @param port_id Egress port
+ * @param queue_id Queue number (below QOS_QUEUES_PER_PORT)
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t qos_clear_queue_stats(port_id_t port_id, uint8_t queue_id);
+
+#endif /* SWITCH_SIM_QOS_H */
@@ -0,0 +1,178 @@
+/**
+ * @file sim_timing.h
+ * @brief Cycle-approximate timing model of the simulated ASIC
+ *
+ * With the model enabled, packets the TX drain takes from a port do not
+ * leave at once. Each gets a modeled departure time: the time it reached
+ * the egress, plus the latency of every pipeline stage it passes, plus
+ * the wait for the port to finish the frames ahead of it, plus its own
+ * serialization time at the port's configured speed (preamble and
+ * inter-frame gap included). A calendar queue holds the packets by
+ * departure time, and one release thread sleeps until the next occupied
+ * bucket is due and hands out everything due in one go, so nothing sleeps
+ * per packet.
+ *
+ * Stage latencies default to CONFIG_SIM_PACKET_DELAY_US split over the
+ * stages, plus CONFIG_SIM_MEMORY_DELAY_NS per table access. Each stage can
+ * add uniform random jitter. Latency and jitter are measured per port on
+ * the modeled times, and the release lateness of the scheduler is counted
+ * next to them.
+ */
+#ifndef SWITCH_SIM_SIM_TIMING_H
+#define SWITCH_SIM_SIM_TIMING_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "port_types.h"
+#include "packet.h"
+
+#define SIM_TIMING_WIRE_OVERHEAD    24      /**< FCS, preamble and inter-frame gap, in bytes */
+#define SIM_TIMING_MIN_FRAME        60      /**< Frames are padded to this before the FCS */
+
+/**
+ * @brief Pipeline stages a packet passes
+ */
+typedef enum {
+    SIM_TIMING_STAGE_PARSER = 0,    /**< Header parsing */
+    SIM_TIMING_STAGE_L2,            /**< VLAN and MAC lookups */
+    SIM_TIMING_STAGE_L3,            /**< Route lookup, IP packets only */
+    SIM_TIMING_STAGE_ACL,           /**< ACL lookup */
+    SIM_TIMING_STAGE_EGRESS,        /**< Buffering and header rewrite */
+    SIM_TIMING_STAGE_COUNT
+} sim_timing_stage_t;
+
+/**
+ * @brief Latency of one stage
+ *
+ * A packet spends latency_ns + memory_accesses * CONFIG_SIM_MEMORY_DELAY_NS
+ * in the stage, plus a uniform random 0..jitter_ns.
+ */
+typedef struct {
+    uint32_t latency_ns;            /**< Fixed latency */
+    uint32_t memory_accesses;       /**< Table reads of the stage */
+    uint32_t jitter_ns;             /**< Largest random extra latency */
+} sim_timing_stage_config_t;
+
+/**
+ * @brief Modeled timing of one port
+ */
+typedef struct {
+    uint64_t packets;               /**< Packets scheduled */
+    uint64_t bytes;                 /**< Bytes scheduled, wire overhead included */
+    uint64_t latency_min_ns;        /**< Lowest egress-to-departure latency, 0 before the first packet */
+    uint64_t latency_max_ns;        /**< Highest latency */
+    uint64_t latency_total_ns;      /**< Sum of the latencies */
+    uint64_t jitter_ns;             /**< Smoothed latency variation between consecutive packets */
+    uint64_t clamped;               /**< Packets due beyond the calendar horizon, released early */
+    uint64_t released;              /**< Packets handed to the port */
+    uint64_t release_late_max_ns;   /**< Highest release time past the modeled departure */
+    uint64_t release_late_total_ns; /**< Sum of the release lateness */
+    uint32_t pending;               /**< Packets in the calendar now */
+} sim_timing_port_stats_t;
+
+/**
+ * @brief Sends packets whose departure time has come; takes ownership
+ */
+typedef void (*sim_timing_release_fn)(port_id_t port_id, packet_buffer_t **pkts, uint32_t count);
+
+/**
+ * @brief Allocate the calendar and start the release thread, model disabled
+ *
+ * @param release Function that sends released packets
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t sim_timing_init(sim_timing_release_fn release);
+
+/**
+ * @brief Stop the release thread and free the packets still scheduled
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t sim_timing_shutdown(void);
+
+/**
+ * @brief Enable or disable the model
+ *
+ * Packets already scheduled still leave at their departure time.
+ *
+ * @param enable True to schedule packets, false to send them at once
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t sim_timing_enable(bool enable);
+
+/**
+ * @brief Check whether packets are scheduled
+ *
+ * @return true if the model is enabled
+ */
+bool sim_timing_enabled(void);
+
+/**
+ * @brief Set the latency of a stage
+ *
+ * @param stage Stage
+ * @param config Latency
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER for a bad stage or NULL config
+ */
+status_t sim_timing_set_stage(sim_timing_stage_t stage, const sim_timing_stage_config_t *config);
+
+/**
+ * @brief Get the latency of a stage
+ *
+ * @param stage Stage
+ * @param[out] config Latency
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER for a bad stage or NULL config
+ */
+status_t sim_timing_get_stage(sim_timing_stage_t stage, sim_timing_stage_config_t *config);
+
+/**
+ * @brief Number of packets the calendar can still take
+ *
+ * @return Free calendar entries
+ */
+uint32_t sim_timing_room(void);
+
+/**
+ * @brief Check whether a port has half the calendar horizon queued already
+ *
+ * The TX drain then leaves the port's packets on its ring, so a port fed
+ * faster than its speed fills its ring and drops, as hardware would.
+ *
+ * @param port_id Egress port
+ * @return true if the port should take no more packets for now
+ */
+bool sim_timing_port_backlogged(port_id_t port_id);
+
+/**
+ * @brief Schedule a burst of packets leaving a port
+ *
+ * The calendar owns the packets taken, a prefix of pkts; the caller keeps
+ * the rest.
+ *
+ * @param port_id Egress port
+ * @param speed Port speed; PORT_SPEED_UNKNOWN adds no serialization delay
+ * @param pkts Packets, in the order they reach the egress
+ * @param count Number of packets
+ * @return Number of packets scheduled
+ */
+uint32_t sim_timing_submit(port_id_t port_id, port_speed_t speed, packet_buffer_t **pkts,
+                           uint32_t count);
+
+/**
+ * @brief Get the modeled timing of a port
+ *
+ * @param port_id Port
+ * @param[out] stats Timing
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t sim_timing_get_port_stats(port_id_t port_id, sim_timing_port_stats_t *stats);
+
+/**
+ * @brief Reset the timing counters of a port
+ *
+ * @param port_id Port
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t sim_timing_clear_port_stats(port_id_t port_id);
+
+#endif /* SWITCH_SIM_SIM_TIMING_H */
@@ -0,0 +1,241 @@
+/**
+ * @file topology.h
+ * @brief Several switches connected by in-memory links in one process
+ *
+ * The topology engine runs a fabric of switches, each a switch instance
+ * (switch_context.h) with its own VLAN state and MAC table, so a test of
+ * many switches needs neither one process per switch nor kernel
+ * interfaces between them.
+ *
+ * Every port of every switch has an SPSC receive ring. A link joins two
+ * ports: a frame a switch sends out of a linked port is put on the peer
+ * port's ring as is, without a copy; flooded copies share the payload.
+ * Ports without a link are edge ports: frames are injected into them
+ * with topology_inject() and frames sent out of them go to the deliver
+ * callback.
+ *
+ * Worker threads own the switches round-robin; a worker drains the rings
+ * of its switches bound to their instance and runs the L2 path on each
+ * frame: VLAN classification, learning, lookup, then unicast or flood
+ * through the VLAN module; multicast floods only to listeners and router
+ * ports in VLANs with IGMP/MLD snooping. MAC tables and snooped groups age
+ * on the simulator clock.
+ *
+ * Switches are configured through the usual VLAN, MAC table, LAG,
+ * snooping and VXLAN calls made while bound to topology_instance(). Frames
+ * of a LAG member are bridged as frames of the LAG, LACPDUs go to the
+ * switch's LAG module and workers run its timers. A switch with a VTEP
+ * bridges VXLAN frames for it as their inner frames received on the
+ * tunnel and encapsulates what it sends to a tunnel. STP, routing and
+ * the rest of the pipeline stay with the process's own switch.
+ *
+ * With a nonzero link latency the fabric is a conservative parallel
+ * discrete-event simulation with its own clock. Every frame carries the
+ * fabric time it reaches its port: the time it was sent plus the latency
+ * of the link. Workers advance together in time windows as long as the
+ * smallest link latency, the lookahead: a frame sent inside a window
+ * cannot arrive before the window ends, so within a window every switch
+ * processes the frames it already has, in time order, independently of
+ * the others, and one barrier per window is all the synchronization
+ * there is. Windows with nothing to do are skipped. The outcome, counters
+ * and delivery times included, does not depend on the number of workers,
+ * unless a ring overflows. MAC tables and groups then age on the fabric clock.
+ */
+#ifndef SWITCH_SIM_TOPOLOGY_H
+#define SWITCH_SIM_TOPOLOGY_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "port_types.h"
+#include "packet.h"
+
+/**
+ * @brief Fabric configuration
+ */
+typedef struct {
+    uint32_t num_switches;      /**< Switches, below CONFIG_MAX_SWITCH_INSTANCES */
+    uint32_t ports_per_switch;  /**< Ports of each switch */
+    uint32_t num_workers;       /**< Worker threads, 0 for one per CPU */
+    uint32_t ring_size;         /**< Receive ring slots per port, a power of two */
+    uint32_t mac_table_size;    /**< MAC table entries of each switch */
+    bool pin_workers;           /**< Pin worker w to CPU w */
+    uint64_t link_latency_ns;   /**< Latency of topology_link() links, 0 to run without a fabric clock */
+} topology_config_t;
+
+/**
+ * @brief Counters of one switch
+ */
+typedef struct {
+    uint64_t rx_packets;        /**< Frames taken from the port rings */
+    uint64_t forwarded;         /**< Frames sent to a learned port */
+    uint64_t flooded;           /**< Frames flooded in their VLAN */
+    uint64_t filtered;          /**< Frames whose destination is behind the ingress port or a blocked or down port */
+    uint64_t dropped;           /**< Frames refused by parsing, VLAN or storm control */
+    uint64_t link_drops;        /**< Copies lost to a full peer ring */
+    uint64_t delivered;         /**< Copies sent out of edge ports */
+    uint64_t lacpdus_rx;        /**< LACPDUs received */
+    uint64_t lacpdus_tx;        /**< LACPDUs sent */
+} topology_switch_stats_t;
+
+/**
+ * @brief State of the fabric clock
+ */
+typedef struct {
+    bool synchronized;          /**< Workers advance in time windows */
+    uint64_t now_ns;            /**< Start of the current window */
+    uint64_t lookahead_ns;      /**< Window length, the smallest link latency */
+    uint64_t windows;           /**< Windows run */
+    uint64_t skipped_ns;        /**< Fabric time jumped over between windows */
+} topology_clock_stats_t;
+
+/**
+ * @brief Takes a frame sent out of an edge port; runs on a worker thread
+ *
+ * @param sw Switch index
+ * @param port_id Edge port
+ * @param packet Frame, owned by the callback
+ * @param arg Argument given to topology_set_deliver()
+ */
+typedef void (*topology_deliver_fn)(uint32_t sw, port_id_t port_id, packet_buffer_t *packet, void *arg);
+
+/**
+ * @brief Fill a configuration with defaults
+ *
+ * @param[out] config Configuration to fill
+ */
+void topology_get_default_config(topology_config_t *config);
+
+/**
+ * @brief Create the switches and their port rings
+ *
+ * Initializes the VLAN module and the MAC table of every switch instance.
+ * Workers are not started yet.
+ *
+ * @param config Configuration
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t topology_init(const topology_config_t *config);
+
+/**
+ * @brief Stop the workers and release the switches
+ *
+ * Frames still on the rings are freed.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t topology_shutdown(void);
+
+/**
+ * @brief Connect two ports
+ *
+ * @param sw_a First switch
+ * @param port_a Port of the first switch
+ * @param sw_b Second switch
+ * @param port_b Port of the second switch
+ * @return STATUS_SUCCESS on success, STATUS_RESOURCE_BUSY while running,
+ *         STATUS_INVALID_PARAMETER for a bad or already linked port
+ */
+status_t topology_link(uint32_t sw_a, port_id_t port_a, uint32_t sw_b, port_id_t port_b);
+
+/**
+ * @brief Connect two ports with a link of its own latency
+ *
+ * @param sw_a First switch
+ * @param port_a Port of the first switch
+ * @param sw_b Second switch
+ * @param port_b Port of the second switch
+ * @param latency_ns Link latency, nonzero
+ * @return STATUS_SUCCESS on success, STATUS_RESOURCE_BUSY while running,
+ *         STATUS_NOT_SUPPORTED without a fabric clock,
+ *         STATUS_INVALID_PARAMETER for a bad or already linked port
+ */
+status_t topology_link_latency(uint32_t sw_a, port_id_t port_a, uint32_t sw_b, port_id_t port_b,
+                               uint64_t latency_ns);
+
+/**
+ * @brief Set the function that takes frames sent out of edge ports
+ *
+ * Without one those frames are counted and freed.
+ *
+ * @param deliver Callback, may be NULL
+ * @param arg Callback argument
+ * @return STATUS_SUCCESS on success, STATUS_RESOURCE_BUSY while running
+ */
+status_t topology_set_deliver(topology_deliver_fn deliver, void *arg);
+
+/**
+ * @brief Start the worker threads
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t topology_start(void);
+
+/**
+ * @brief Switch instance of a switch, for switch_context_bind()
+ *
+ * @param sw Switch index
+ * @return Instance number, SWITCH_INSTANCE_DEFAULT for a bad index
+ */
+uint32_t topology_instance(uint32_t sw);
+
+/**
+ * @brief Inject frames into an edge port
+ *
+ * May be called from any thread. The fabric takes a prefix of pkts; the
+ * caller keeps the rest.
+ *
+ * @param sw Switch index
+ * @param port_id Edge port
+ * @param pkts Frames
+ * @param count Number of frames
+ * @return Number of frames taken
+ */
+uint32_t topology_inject(uint32_t sw, port_id_t port_id, packet_buffer_t **pkts, uint32_t count);
+
+/**
+ * @brief Inject frames into an edge port at a fabric time
+ *
+ * As topology_inject(), but the frames arrive at at_ns. A time the fabric
+ * has already passed, or one before earlier frames of the port, becomes
+ * the earliest time still possible. Without a fabric clock the time is
+ * ignored.
+ *
+ * @param sw Switch index
+ * @param port_id Edge port
+ * @param pkts Frames
+ * @param count Number of frames
+ * @param at_ns Fabric time of arrival
+ * @return Number of frames taken
+ */
+uint32_t topology_inject_at(uint32_t sw, port_id_t port_id, packet_buffer_t **pkts, uint32_t count,
+                            uint64_t at_ns);
+
+/**
+ * @brief Current fabric time
+ *
+ * On a worker thread, from the deliver callback for instance, this is the
+ * time of the frame being processed; elsewhere the start of the current
+ * window. 0 without a fabric clock.
+ *
+ * @return Fabric time in nanoseconds
+ */
+uint64_t topology_now_ns(void);
+
+/**
+ * @brief Get the state of the fabric clock
+ *
+ * @param[out] stats Clock state
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t topology_get_clock_stats(topology_clock_stats_t *stats);
+
+/**
+ * @brief Get the counters of a switch
+ *
+ * @param sw Switch index
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t topology_get_switch_stats(uint32_t sw, topology_switch_stats_t *stats);
+
+#endif /* SWITCH_SIM_TOPOLOGY_H */
@@ -0,0 +1,291 @@
+/**
+ * @file lag.h
+ * @brief Link aggregation groups with LACP (IEEE 802.1AX)
+ *
+ * A LAG bundles member ports into one logical port. LAG n has port ID
+ * LAG_PORT_ID(n), above every physical port, and the MAC table and the
+ * VLAN module take it wherever they take a port: frames received on a
+ * member are classified, learned and filtered as received on the LAG,
+ * and a LAG joins VLANs like any port. Member ports themselves carry no
+ * traffic of their own.
+ *
+ * Sending to a LAG sends out of one member, chosen by a hash of the
+ * frame's parsed headers (L2, L3 or L3+L4), so a flow stays on one link
+ * and frames of a flow stay in order. The members that can take traffic
+ * form a distribution table published with one atomic pointer store
+ * under RCU: a member going down replaces the table, its flows move to
+ * the remaining members from the next frame on, and no MAC entry needs
+ * flushing because the entries point at the LAG, not at the member.
+ *
+ * Members of an LACP LAG exchange LACPDUs with the partner switch and
+ * only collect and distribute once both ends agree; members of a static
+ * LAG distribute whenever their link is up. All members that take
+ * traffic share one partner system and key; members facing another
+ * partner stay selected out.
+ *
+ * State is per switch instance (switch_context.h). The caller drives the
+ * protocol: received LACPDUs go to lag_receive_lacpdu() and
+ * lag_process_timers() sends the periodic ones. Link changes of the
+ * process's own switch arrive through link events; other instances
+ * report them with lag_set_member_link().
+ */
+#ifndef SWITCH_SIM_LAG_H
+#define SWITCH_SIM_LAG_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../common/config.h"
+#include "../hal/packet.h"
+
+/**
+ * @brief Port ID of LAG index
+ */
+#define LAG_PORT_ID(index) ((port_id_t)(CONFIG_LAG_PORT_BASE + (index)))
+
+/**
+ * @brief LACP actor and partner state bits
+ */
+#define LACP_STATE_ACTIVITY         0x01    /**< Active LACP */
+#define LACP_STATE_TIMEOUT          0x02    /**< Short timeout */
+#define LACP_STATE_AGGREGATION      0x04    /**< Aggregatable link */
+#define LACP_STATE_SYNC             0x08    /**< In sync with the selected aggregator */
+#define LACP_STATE_COLLECTING       0x10    /**< Receiving frames */
+#define LACP_STATE_DISTRIBUTING     0x20    /**< Sending frames */
+#define LACP_STATE_DEFAULTED        0x40    /**< No partner information */
+#define LACP_STATE_EXPIRED          0x80    /**< Partner information timed out */
+
+/**
+ * @brief How members negotiate
+ */
+typedef enum {
+    LAG_MODE_STATIC = 0,            /**< No LACP; a member with link up distributes */
+    LAG_MODE_LACP_ACTIVE,           /**< Sends LACPDUs unprompted */
+    LAG_MODE_LACP_PASSIVE           /**< Sends LACPDUs only to an active partner */
+} lag_mode_t;
+
+/**
+ * @brief Headers hashed to choose the egress member
+ */
+typedef enum {
+    LAG_HASH_L2 = 0,                /**< MAC addresses and ethertype */
+    LAG_HASH_L3,                    /**< IP addresses and protocol, L2 for non-IP */
+    LAG_HASH_L3_L4                  /**< As L3 plus TCP/UDP ports of unfragmented datagrams */
+} lag_hash_t;
+
+/**
+ * @brief LAG configuration
+ */
+typedef struct {
+    lag_mode_t mode;                /**< Negotiation */
+    lag_hash_t hash;                /**< Member selection */
+    bool lacp_fast;                 /**< Ask the partner for LACPDUs every second, not every 30 */
+} lag_config_t;
+
+/**
+ * @brief State of one member
+ */
+typedef struct {
+    port_id_t port_id;              /**< Member port */
+    bool link_up;                   /**< Link state last reported */
+    bool selected;                  /**< Attached to the LAG's partner */
+    bool distributing;              /**< In the distribution table */
+    uint8_t actor_state;            /**< LACP_STATE_* sent */
+    uint8_t partner_state;          /**< LACP_STATE_* received, 0 without a partner */
+    uint16_t partner_system_priority; /**< Partner system priority */
+    mac_addr_t partner_system;      /**< Partner system ID */
+    uint16_t partner_key;           /**< Partner operational key */
+    uint16_t partner_port;          /**< Partner port number */
+    uint64_t lacpdus_rx;            /**< LACPDUs received */
+    uint64_t lacpdus_tx;            /**< LACPDUs sent */
+} lag_member_info_t;
+
+/**
+ * @brief State of one LAG
+ */
+typedef struct {
+    port_id_t lag_port;             /**< Port ID of the LAG */
+    lag_config_t config;            /**< Configuration */
+    uint16_t key;                   /**< Actor operational key */
+    uint32_t member_count;          /**< Members */
+    uint32_t active_count;          /**< Members in the distribution table */
+    uint64_t table_updates;         /**< Distribution tables published */
+    lag_member_info_t members[CONFIG_LAG_MAX_MEMBERS]; /**< member_count entries */
+} lag_info_t;
+
+/**
+ * @brief Sends a LACPDU out of a member port
+ *
+ * @param port_id Member port
+ * @param packet Frame, owned by the callee
+ * @param arg Argument given to lag_process_timers()
+ */
+typedef void (*lag_transmit_fn)(port_id_t port_id, packet_buffer_t *packet, void *arg);
+
+/**
+ * @brief Whether a port ID belongs to a LAG, created or not
+ */
+static inline bool lag_port_is_lag(port_id_t port_id) {
+    return port_id >= CONFIG_LAG_PORT_BASE && port_id < CONFIG_LAG_PORT_BASE + CONFIG_MAX_LAGS;
+}
+
+/**
+ * @brief Initialize the LAG module of the current switch instance
+ *
+ * The system ID used in LACPDUs defaults to the MAC of port 0 on the
+ * process's own switch and to a locally administered address derived
+ * from the instance number elsewhere.
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t lag_init(void);
+
+/**
+ * @brief Delete every LAG and free the module state of the current instance
+ *
+ * Must not run concurrently with the forwarding calls.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t lag_deinit(void);
+
+/**
+ * @brief Fill a configuration with defaults: active LACP, L3+L4 hash, slow rate
+ *
+ * @param[out] config Configuration to fill
+ */
+void lag_get_default_config(lag_config_t *config);
+
+/**
+ * @brief Set the LACP system ID
+ *
+ * @param system System MAC
+ * @param priority System priority
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t lag_set_system(const mac_addr_t *system, uint16_t priority);
+
+/**
+ * @brief Create a LAG without members
+ *
+ * @param lag_port Port ID, LAG_PORT_ID(n) for n below CONFIG_MAX_LAGS
+ * @param config Configuration, NULL for the defaults
+ * @return STATUS_SUCCESS on success, STATUS_ALREADY_EXISTS if the LAG
+ *         exists, STATUS_INVALID_PARAMETER
+ */
+status_t lag_create(port_id_t lag_port, const lag_config_t *config);
+
+/**
+ * @brief Delete a LAG and release its members
+ *
+ * @param lag_port LAG
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if there is no such LAG
+ */
+status_t lag_delete(port_id_t lag_port);
+
+/**
+ * @brief Change the configuration of a LAG
+ *
+ * @param lag_port LAG
+ * @param config New configuration
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t lag_set_config(port_id_t lag_port, const lag_config_t *config);
+
+/**
+ * @brief Add a physical port to a LAG
+ *
+ * The port starts with its current link state on the process's own
+ * switch and with link up on other instances.
+ *
+ * @param lag_port LAG
+ * @param port_id Port, not a member of any LAG
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if there is no such
+ *         LAG, STATUS_RESOURCE_BUSY if the port is a member already,
+ *         STATUS_RESOURCE_EXHAUSTED if the LAG is full
+ */
+status_t lag_add_member(port_id_t lag_port, port_id_t port_id);
+
+/**
+ * @brief Remove a port from its LAG
+ *
+ * @param lag_port LAG
+ * @param port_id Member port
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if it is not a member
+ */
+status_t lag_remove_member(port_id_t lag_port, port_id_t port_id);
+
+/**
+ * @brief Report the link state of a member
+ *
+ * A member going down leaves the distribution table at once.
+ *
+ * @param port_id Port
+ * @param link_up New link state
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if the port is not a member
+ */
+status_t lag_set_member_link(port_id_t port_id, bool link_up);
+
+/**
+ * @brief Port a frame received on a physical port belongs to
+ *
+ * Lock-free.
+ *
+ * @param port_id Receiving port
+ * @return The port itself unless it is a LAG member; the LAG if the
+ *         member is collecting; PORT_ID_INVALID if the frame must be
+ *         dropped
+ */
+port_id_t lag_ingress_port(port_id_t port_id);
+
+/**
+ * @brief Physical port that sends a frame out of a port
+ *
+ * Lock-free. The frame must have been parsed (packet_parse()).
+ *
+ * @param port_id Egress port or LAG
+ * @param packet Frame, hashed to choose the member of a LAG
+ * @return The port itself unless it is a LAG or a LAG member; a
+ *         distributing member for a LAG; PORT_ID_INVALID for a LAG
+ *         without one and for a member port
+ */
+port_id_t lag_egress_port(port_id_t port_id, const packet_buffer_t *packet);
+
+/**
+ * @brief Whether a frame is a LACPDU (slow protocols, subtype 1)
+ */
+bool lag_is_lacpdu(const packet_buffer_t *packet);
+
+/**
+ * @brief Process a LACPDU received on a member
+ *
+ * @param port_id Receiving port
+ * @param packet LACPDU, not consumed
+ * @param now_ms Current time in milliseconds, the clock of lag_process_timers()
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if the port is not
+ *         a member of an LACP LAG, STATUS_INVALID_PACKET if malformed
+ */
+status_t lag_receive_lacpdu(port_id_t port_id, const packet_buffer_t *packet, uint64_t now_ms);
+
+/**
+ * @brief Expire stale partners and send the LACPDUs that are due
+ *
+ * Call at least every few hundred milliseconds. The transmit callback
+ * runs outside the module lock.
+ *
+ * @param now_ms Current time in milliseconds, any monotonic origin
+ * @param transmit Sends a LACPDU
+ * @param arg Argument of transmit
+ * @return Number of LACPDUs sent
+ */
+uint32_t lag_process_timers(uint64_t now_ms, lag_transmit_fn transmit, void *arg);
+
+/**
+ * @brief Get the state of a LAG and its members
+ *
+ * @param lag_port LAG
+ * @param[out] info State
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if there is no such LAG
+ */
+status_t lag_get_info(port_id_t lag_port, lag_info_t *info);
+
+#endif /* SWITCH_SIM_LAG_H */
@@ -39,6 +39,11 @@ typedef struct mac_learning_stats {
     uint32_t learning_latency_us;  /**< Average learning latency in microseconds */
     uint32_t lookup_latency_us;    /**< Average lookup latency in microseconds */
 
+    /* Learning queue statistics */
+    uint32_t queued_events;        /**< Learn events queued by forwarding threads */
+    uint32_t queue_drops;          /**< Learn events dropped because a queue was full */
+    uint32_t dedup_hits;           /**< Learn events suppressed as recent duplicates */
+
     /* Operational state */
     bool learning_enabled;         /**< Whether global MAC learning is currently enabled */
     uint32_t last_reset_time;      /**< Timestamp of the last statistics reset (seconds since boot) */
@@ -73,6 +78,40 @@ status_t mac_learning_get_stats(mac_learning_stats_t *stats);
  */
 status_t mac_learning_reset_stats(void);
 
+/**
+ * @brief Learn the source MAC of a received packet
+ *
+ * A source already known on the ingress port only refreshes its entry,
+ * without taking a lock. While the learner thread runs, new and moved
+ * sources are queued on the calling thread's learn queue; otherwise they
+ * are written to the MAC table before returning.
+ * @param packet Received packet
+ * @param port_id Ingress port
+ * @param current_time Current time in seconds
+ * @return status_t STATUS_SUCCESS on success, error code otherwise
+ */
+status_t mac_learning_process_packet(const packet_buffer_t *packet, port_id_t port_id, uint32_t current_time);
+
+/**
+ * @brief Start the learner thread and switch learning to queued mode
+ * @return status_t STATUS_SUCCESS on success, error code otherwise
+ */
+status_t mac_learning_start_learner(void);
+
+/**
+ * @brief Stop the learner thread, apply what is still queued and return to inline learning
+ * @return status_t STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not running
+ */
+status_t mac_learning_stop_learner(void);
+
+/**
+ * @brief Apply queued learn events now
+ * Called by the learner thread. Safe from any thread: a call made while
+ * another drain is running returns 0 at once.
+ * @return uint32_t Number of events taken from the queues
+ */
+uint32_t mac_learning_drain_queues(void);
+
 /**
  * @brief Cleanup and release resources used by the MAC learning module
  *
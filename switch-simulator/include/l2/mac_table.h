@@ -10,6 +10,7 @@
 #include "../common/types.h"
 #include "../common/error_codes.h"
 #include "../common/threading.h"
+#include "../common/table_cursor.h"
 #include "../hal/packet.h"
 #include "../hal/port.h"
 #include "../hal/hw_resources.h"
@@ -78,6 +79,108 @@ typedef struct {
 typedef void (*mac_event_callback_t)(mac_table_entry_t *entry, bool is_added, void *user_data);
 
 
+/**
+ * @brief MAC move dampening event
+ */
+typedef struct {
+    mac_addr_t     mac_addr;      /**< Flapping MAC address */
+    vlan_id_t      vlan_id;       /**< VLAN ID */
+    port_id_t      port_id;       /**< Port the MAC is frozen on */
+    port_id_t      moved_to;      /**< Port of the refused move */
+    uint32_t       timestamp;     /**< Time the MAC was frozen */
+    uint32_t       frozen_until;  /**< Time moves are accepted again */
+} mac_move_event_t;
+
+/**
+ * @brief Number of move events kept by the MAC table
+ */
+#define MAC_MOVE_EVENT_RING_SIZE 256
+
+/**
+ * @brief Copy of the MAC table taken without blocking writers
+ *
+ * Entries are sorted by MAC address and VLAN. Every entry present for the
+ * whole copy appears exactly once; entries added, removed or moved while
+ * it was taken may show either state.
+ */
+typedef struct {
+    mac_table_entry_t *entries;   /**< Copied entries */
+    uint32_t       count;         /**< Number of entries */
+    uint32_t       timestamp;     /**< Table time when the copy was taken */
+} mac_table_snapshot_t;
+
+/**
+ * @brief Magic and version of a packed MAC table export ("MACT", v1)
+ */
+#define MAC_TABLE_EXPORT_MAGIC   0x5443414D
+#define MAC_TABLE_EXPORT_VERSION 1
+
+/**
+ * @brief Header of a packed MAC table export, in host byte order
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t       magic;         /**< MAC_TABLE_EXPORT_MAGIC */
+    uint16_t       version;       /**< MAC_TABLE_EXPORT_VERSION */
+    uint16_t       record_size;   /**< sizeof(mac_table_export_record_t) */
+    uint32_t       count;         /**< Number of records following the header */
+    uint32_t       timestamp;     /**< Table time when the export was taken */
+} mac_table_export_header_t;
+
+/**
+ * @brief One entry of a packed MAC table export
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t        mac_addr[MAC_ADDR_LEN]; /**< MAC address */
+    uint16_t       vlan_id;       /**< VLAN ID */
+    uint16_t       port_id;       /**< Port ID */
+    uint8_t        type;          /**< mac_entry_type_t */
+    uint8_t        aging;         /**< mac_aging_state_t */
+    uint32_t       age_timestamp; /**< Last time the entry was used */
+} mac_table_export_record_t;
+
+/**
+ * @brief Limits of an emulated hardware hash layout
+ */
+#define MAC_TABLE_HW_MAX_BANKS 8
+#define MAC_TABLE_HW_MAX_WAYS  16
+
+/**
+ * @brief How new entries are placed
+ */
+typedef enum {
+    MAC_TABLE_MODE_CUCKOO = 0,   /**< Simulator table only; fails only when full */
+    MAC_TABLE_MODE_BANKED        /**< Also place entries in emulated d-left hash banks */
+} mac_table_mode_t;
+
+/**
+ * @brief Hardware hash bank layout to emulate
+ *
+ * In MAC_TABLE_MODE_BANKED each key hashes to one row in every bank and
+ * goes to the least loaded of those rows (leftmost on a tie). When all of
+ * them are full it takes a free overflow entry of the first bank that has
+ * one, and otherwise learning fails, as on an ASIC whose hash banks have
+ * collided.
+ */
+typedef struct {
+    mac_table_mode_t mode;        /**< Placement mode */
+    uint32_t       banks;         /**< Hash banks, 1..MAC_TABLE_HW_MAX_BANKS */
+    uint32_t       rows;          /**< Rows per bank */
+    uint32_t       ways;          /**< Entries per row, 1..MAC_TABLE_HW_MAX_WAYS */
+    uint32_t       overflow;      /**< Overflow (CAM) entries per bank */
+} mac_table_hw_profile_t;
+
+/**
+ * @brief Occupancy of one emulated hash bank
+ */
+typedef struct {
+    uint32_t       capacity;          /**< Row entries (rows * ways) */
+    uint32_t       used;              /**< Row entries in use */
+    uint32_t       overflow_capacity; /**< Overflow entries */
+    uint32_t       overflow_used;     /**< Overflow entries in use */
+    uint32_t       full_rows;         /**< Rows with every way in use */
+    uint64_t       row_collisions;    /**< Inserts that found this bank's row full */
+} mac_table_hw_bank_stats_t;
+
 /**
  * @brief Callback function type for iterating through MAC table entries
  *
@@ -125,6 +228,7 @@ typedef struct {
     uint32_t dynamic_entries;   /**< Number of dynamic entries */
     uint32_t table_size;        /**< Size of the hash table */
     uint32_t aging_time;        /**< Current aging time in seconds */
+    uint64_t learn_failures;    /**< New entries refused for lack of space */
 } mac_table_stats_t;
 
 
@@ -138,7 +242,7 @@ mac_table_internal_t* mac_table_get_instance(void);
 /**
  * @brief Initialize the MAC address table
  *
- * @param size Hash table size (0 for default)
+ * @param size Maximum number of entries (0 for default)
  * @param aging_time Aging time in seconds (0 for default)
  * @return status_t STATUS_SUCCESS on success
  */
@@ -160,6 +264,29 @@ status_t mac_table_deinit(void);
  */
 status_t mac_table_check_resources(uint32_t count, bool *available);
 
+/**
+ * @brief Select the hardware hash layout new entries are placed in
+ *
+ * Usually taken from the BSP board profile. The table must be empty.
+ *
+ * @param profile Layout to emulate
+ * @return status_t STATUS_SUCCESS on success, STATUS_RESOURCE_BUSY if the
+ *         table holds entries
+ */
+status_t mac_table_set_hw_profile(const mac_table_hw_profile_t *profile);
+
+/**
+ * @brief Get the occupancy of each emulated hash bank
+ *
+ * @param stats Array to store per-bank statistics
+ * @param max_banks Size of the stats array
+ * @param count Output parameter to store number of banks returned;
+ *              0 in MAC_TABLE_MODE_CUCKOO
+ * @return status_t STATUS_SUCCESS on success
+ */
+status_t mac_table_get_hw_bank_stats(mac_table_hw_bank_stats_t *stats, uint32_t max_banks,
+                                     uint32_t *count);
+
 /**
  * @brief Get MAC table statistics
  *
@@ -168,6 +295,15 @@ status_t mac_table_check_resources(uint32_t count, bool *available);
  */
 status_t mac_table_get_stats(mac_table_stats_t *stats);
 
+/**
+ * @brief Get the MAC table generation
+ *
+ * Bumped whenever an entry moves to another port or is removed.
+ *
+ * @return uint32_t Current generation
+ */
+uint32_t mac_table_get_generation(void);
+
 /**
  * @brief Add a static entry to the MAC table
  *
@@ -198,6 +334,28 @@ status_t mac_table_delete_entry(mac_addr_t mac_addr, vlan_id_t vlan_id);
 //status_t mac_table_lookup(mac_addr_t mac_addr, vlan_id_t vlan_id, mac_table_entry_t *entry);
 status_t mac_table_lookup(const mac_addr_t mac, vlan_id_t vlan_id, port_id_t *port_id);
 
+/**
+ * @brief Maximum number of addresses per mac_table_lookup_bulk() call
+ */
+#define MAC_TABLE_BULK_MAX 64
+
+/**
+ * @brief Look up a burst of MAC addresses
+ *
+ * Hashes every key and prefetches its buckets before resolving any of
+ * them. Found entries are refreshed as by mac_table_lookup(); ports[i] is
+ * PORT_ID_INVALID for addresses not found.
+ *
+ * @param macs MAC addresses
+ * @param vlans VLAN ID of each address
+ * @param n Number of addresses, at most MAC_TABLE_BULK_MAX
+ * @param ports Output port of each address
+ * @param hit_mask Output bit mask, bit i set if macs[i] was found
+ * @return status_t STATUS_SUCCESS on success, error code otherwise
+ */
+status_t mac_table_lookup_bulk(const mac_addr_t *macs, const vlan_id_t *vlans, uint32_t n,
+                               port_id_t *ports, uint64_t *hit_mask);
+
 /**
  * @brief Add a MAC entry to the table (static or dynamic)
  *
@@ -209,6 +367,15 @@ status_t mac_table_lookup(const mac_addr_t mac, vlan_id_t vlan_id, port_id_t *po
  */
 status_t mac_table_add(const mac_addr_t    mac, port_id_t port_id, vlan_id_t vlan_id, bool is_static);
 
+/**
+ * @brief Remove a MAC entry from the table
+ *
+ * @param mac MAC address
+ * @param vlan_id VLAN ID
+ * @return status_t STATUS_SUCCESS, or STATUS_NOT_FOUND if there is no such entry
+ */
+status_t mac_table_remove(const mac_addr_t mac, vlan_id_t vlan_id);
+
 /**
  * @brief Process MAC learning for an incoming packet
  *
@@ -281,21 +448,79 @@ status_t mac_table_get_resource_usage(hw_resource_usage_t *usage);
  * @brief Get all entries in the MAC table
  *
  * @param entries Array to store MAC table entries
+ * Entries are copied without blocking writers, as for
+ * mac_table_snapshot_create().
+ *
  * @param max_entries Size of the entries array
  * @param count Output parameter to store number of entries returned
- * @return status_t STATUS_SUCCESS on success
+ * @return status_t STATUS_SUCCESS on success, STATUS_OUT_OF_BOUNDS if the
+ *         table holds more than max_entries entries (the first
+ *         max_entries are returned)
  */
 status_t mac_table_get_entries(mac_table_entry_t *entries, uint32_t max_entries, uint32_t *count);
 
+/**
+ * @brief Get the next page of MAC table entries
+ *
+ * Buckets are read without blocking writers, and the table may grow
+ * between pages (see table_cursor.h). A key that a cuckoo displacement
+ * moves behind the cursor between two pages is missed, and one moved
+ * ahead of it is returned twice; take a snapshot where an exact copy is
+ * needed.
+ *
+ * @param cursor TABLE_CURSOR_START to begin; moved past the entries
+ *               returned, TABLE_CURSOR_END once the table is done
+ * @param entries Array to store MAC table entries, in no particular order
+ * @param max_entries Size of the entries array
+ * @param count Output parameter to store number of entries returned
+ * @return status_t STATUS_SUCCESS on success
+ */
+status_t mac_table_get_entries_page(table_cursor_t *cursor, mac_table_entry_t *entries,
+                                    uint32_t max_entries, uint32_t *count);
+
 /**
  * @brief Iterate through all entries in the MAC table
  *
+ * The callback runs on a snapshot with no table lock held, so it may
+ * add or remove entries.
+ *
  * @param callback Function to call for each entry
  * @param user_data User data to pass to callback
  * @return status_t STATUS_SUCCESS on success
  */
 status_t mac_table_iterate(mac_table_iter_cb_t callback, void *user_data);
 
+/**
+ * @brief Take a snapshot of the MAC table without blocking writers
+ *
+ * @param snapshot Receives the snapshot; release it with
+ *                 mac_table_snapshot_free()
+ * @return status_t STATUS_SUCCESS on success
+ */
+status_t mac_table_snapshot_create(mac_table_snapshot_t *snapshot);
+
+/**
+ * @brief Release a snapshot taken by mac_table_snapshot_create()
+ *
+ * @param snapshot Snapshot to release
+ */
+void mac_table_snapshot_free(mac_table_snapshot_t *snapshot);
+
+/**
+ * @brief Export the MAC table as a packed binary image
+ *
+ * Writes a mac_table_export_header_t followed by one
+ * mac_table_export_record_t per entry, taken from a snapshot.
+ *
+ * @param buffer Output buffer
+ * @param size Size of the buffer in bytes
+ * @param written Receives the bytes written, or the bytes needed if the
+ *                buffer is too small
+ * @return status_t STATUS_SUCCESS on success, STATUS_OUT_OF_BOUNDS if the
+ *         buffer is too small
+ */
+status_t mac_table_export(void *buffer, uint32_t size, uint32_t *written);
+
 /**
  * @brief Configure MAC learning on a specific port
  *
@@ -308,6 +533,16 @@ status_t mac_table_configure_port_learning(port_id_t port_id, bool enable);
 /**
  * @brief Register callback for MAC address change events
  *
+ * Called outside table locks, on the thread that changed the table:
+ * - a dynamic entry is learned or moves port (is_added true, entry on its new port)
+ * - a dynamic entry ages out (is_added false)
+ * - a dynamic entry that moves between ports more than
+ *   CONFIG_MAC_MOVE_THRESHOLD times is frozen on its port (is_added true,
+ *   entry on the port it is held to)
+ *
+ * Static entries, explicit removals and flushes are not reported. The
+ * callback runs on the learning path and should return quickly.
+ *
  * @param callback Function to call when MAC events occur
  * @param user_data User data to pass to callback
  * @return status_t STATUS_SUCCESS on success
@@ -321,6 +556,16 @@ status_t mac_table_register_event_callback(mac_event_callback_t callback, void *
  */
 status_t mac_table_unregister_event_callback(void);
 
+/**
+ * @brief Get the most recent MAC move dampening events
+ *
+ * @param events Array to store the events, oldest first
+ * @param max_events Size of the events array
+ * @param count Output parameter to store number of events returned
+ * @return status_t STATUS_SUCCESS on success
+ */
+status_t mac_table_get_move_events(mac_move_event_t *events, uint32_t max_events, uint32_t *count);
+
 
 #endif /* SWITCH_SIM_MAC_TABLE_H */
 
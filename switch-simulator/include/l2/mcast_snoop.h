@@ -0,0 +1,200 @@
+/**
+ * @file mcast_snoop.h
+ * @brief IGMP and MLD snooping
+ *
+ * Without snooping a multicast frame floods its whole VLAN. With snooping
+ * enabled on a VLAN the switch listens to IGMPv1/v2/v3 and MLDv1/v2
+ * reports and keeps, for every group joined in the VLAN, the bitmap of
+ * the ports with listeners. A frame to a group then goes only to those
+ * ports and to the VLAN's router ports, the ports queries and PIM hellos
+ * arrive on.
+ *
+ * Groups are tracked by destination MAC address, as a switch forwards
+ * them: IPv4 groups map to 01:00:5e plus 23 bits of the address, IPv6
+ * groups to 33:33 plus the last 32 bits, so groups sharing a MAC share
+ * an entry. Groups of the link-local scope (224.0.0.x, ff02::x map into
+ * 01:00:5e:00:00:xx and 33:33:00:00:00:xx) always flood. Reports and
+ * leaves go to router ports only; queries flood. Source lists of v3/v2
+ * reports are not tracked: a record that keeps any source joins the
+ * group, and a change to include nothing leaves it.
+ *
+ * The table is a bucketized two-choice hash in the layout of the MAC
+ * table: keys in cache-line buckets, the port bitmaps in a parallel
+ * array, lock-free lookups checked by a sequence counter. Membership is
+ * aged in epochs of half the membership interval with a bitmap of the
+ * ports heard from in the current epoch, so an entry is a few bitmaps
+ * whatever the port count and a port that stops reporting leaves between
+ * half and all of the interval after its last report; hosts report once
+ * per query interval, which is shorter. The group timers are one-second
+ * timing wheel items re-queued lazily, so a timer pass touches only the
+ * groups that are due.
+ *
+ * State is per switch instance (switch_context.h). The caller runs the
+ * timers with mcast_snoop_process_timers(), on the clock of its MAC table.
+ */
+#ifndef SWITCH_SIM_MCAST_SNOOP_H
+#define SWITCH_SIM_MCAST_SNOOP_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../hal/packet.h"
+#include "vlan.h"
+
+/**
+ * @brief Snooping configuration
+ */
+typedef struct {
+    uint32_t membership_interval;   /**< Seconds a port stays a member without a report, at least 2 */
+    uint32_t router_interval;       /**< Seconds a port stays a router port without a query, at least 2 */
+    uint32_t last_member_time;      /**< Seconds a port stays a member after a leave */
+    bool fast_leave;                /**< Remove a port at once on a leave */
+    bool flood_unregistered;        /**< Flood groups without listeners instead of sending them to router ports */
+} mcast_snoop_config_t;
+
+/**
+ * @brief Snooping counters
+ */
+typedef struct {
+    uint64_t reports;               /**< Reports and leaves processed */
+    uint64_t queries;               /**< Queries and PIM hellos seen */
+    uint64_t forwarded;             /**< Frames sent to listeners and router ports only */
+    uint64_t unregistered;          /**< Frames to groups without listeners */
+    uint64_t table_full;            /**< Joins refused for lack of space */
+    uint32_t groups;                /**< Group entries in the table */
+} mcast_snoop_stats_t;
+
+/**
+ * @brief Listeners of one group
+ */
+typedef struct {
+    vlan_id_t vlan_id;              /**< VLAN */
+    mac_addr_t group;               /**< Group MAC address */
+    vlan_port_bitmap_t ports;       /**< Ports with listeners */
+} mcast_snoop_group_t;
+
+/**
+ * @brief Initialize snooping of the current switch instance, disabled on every VLAN
+ *
+ * @param max_groups Table capacity, 0 for CONFIG_MCAST_SNOOP_MAX_GROUPS
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t mcast_snoop_init(uint32_t max_groups);
+
+/**
+ * @brief Free the snooping state of the current instance
+ *
+ * Must not run concurrently with the forwarding calls.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t mcast_snoop_deinit(void);
+
+/**
+ * @brief Fill a configuration with the IGMP defaults: 260 s membership and
+ * router intervals, 2 s after a leave, no fast leave, no unregistered flooding
+ *
+ * @param[out] config Configuration to fill
+ */
+void mcast_snoop_get_default_config(mcast_snoop_config_t *config);
+
+/**
+ * @brief Set the configuration
+ *
+ * Entries learned already keep their deadlines.
+ *
+ * @param config Configuration
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER for intervals below 2
+ */
+status_t mcast_snoop_set_config(const mcast_snoop_config_t *config);
+
+/**
+ * @brief Enable or disable snooping on a VLAN
+ *
+ * Disabling drops the groups and router ports learned in the VLAN.
+ *
+ * @param vlan_id VLAN
+ * @param enable Whether multicast of the VLAN is constrained
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t mcast_snoop_set_vlan(vlan_id_t vlan_id, bool enable);
+
+/**
+ * @brief Make a port a router port of a VLAN for good, or return it to detection
+ *
+ * @param vlan_id VLAN
+ * @param port_id Port or LAG
+ * @param is_static true to pin the port, false to let it age
+ * @return STATUS_SUCCESS on success, STATUS_TABLE_FULL without room
+ */
+status_t mcast_snoop_set_router_port(vlan_id_t vlan_id, port_id_t port_id, bool is_static);
+
+/**
+ * @brief Learn from a frame and choose where a multicast frame goes
+ *
+ * Lock-free for data frames; reports and queries take the table lock.
+ * The frame must have been parsed (packet_parse()) and classified: its
+ * ingress port and VLAN are the ones given.
+ *
+ * @param packet Frame received
+ * @param vlan_id VLAN of the frame
+ * @param in_port Ingress port or LAG
+ * @param[out] ports Ports the frame goes to, ingress port included
+ * @return true if the frame goes to ports only, false if it floods its VLAN
+ */
+bool mcast_snoop_process(const packet_buffer_t *packet, vlan_id_t vlan_id, port_id_t in_port,
+                         vlan_port_bitmap_t *ports);
+
+/**
+ * @brief Run the group and router port timers due up to now
+ *
+ * @param now Current time in seconds, the clock of the switch's MAC table
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t mcast_snoop_process_timers(uint32_t now);
+
+/**
+ * @brief Get the listeners of a group
+ *
+ * @param vlan_id VLAN
+ * @param group Group MAC address
+ * @param[out] ports Ports with listeners
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND without listeners
+ */
+status_t mcast_snoop_get_group(vlan_id_t vlan_id, const mac_addr_t *group, vlan_port_bitmap_t *ports);
+
+/**
+ * @brief Get the router ports of a VLAN
+ *
+ * @param vlan_id VLAN
+ * @param[out] ports Router ports, static and detected
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t mcast_snoop_get_router_ports(vlan_id_t vlan_id, vlan_port_bitmap_t *ports);
+
+/**
+ * @brief Copy up to max groups of the table
+ *
+ * @param[out] groups Groups
+ * @param max Capacity of groups
+ * @param[out] count Groups copied
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t mcast_snoop_get_groups(mcast_snoop_group_t *groups, uint32_t max, uint32_t *count);
+
+/**
+ * @brief Remove a port from every group and router port set, e.g. on link down
+ *
+ * @param port_id Port or LAG
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t mcast_snoop_flush_port(port_id_t port_id);
+
+/**
+ * @brief Get the counters
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t mcast_snoop_get_stats(mcast_snoop_stats_t *stats);
+
+#endif /* SWITCH_SIM_MCAST_SNOOP_H */
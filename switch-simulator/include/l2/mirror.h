@@ -0,0 +1,176 @@
+/**
+ * @file mirror.h
+ * @brief Port and VLAN mirroring (SPAN and RSPAN)
+ *
+ * A mirror session copies the frames received on or sent from its source
+ * ports, and received in or sent in its source VLANs, to one destination
+ * port where an analyzer listens. A copy shares the payload of the frame
+ * it mirrors: it is a referenced slice, optionally cut to the session's
+ * truncation length, and never a copy of the data. An RSPAN session adds
+ * an outer 802.1Q tag of its RSPAN VLAN, written into the headroom of a
+ * small header segment chained in front of the slice, so the copy can be
+ * carried through other switches to a remote analyzer.
+ *
+ * A session may sample 1 in N frames, counted per forwarding thread so
+ * sampling shares no cache line. Copies are queued on the destination
+ * port like any other egress traffic, in its QoS queues when it has them
+ * and on its TX ring otherwise; a copy the destination refuses because it
+ * is congested is dropped and counted against the session, never against
+ * the mirrored traffic.
+ *
+ * Ingress mirroring is a pipeline stage ahead of the ACL, so frames the
+ * pipeline later drops are still mirrored. Egress mirroring runs where
+ * frames are handed to a port: port_send_packet(), port_send_burst() and
+ * hw_sim_tx_enqueue_burst(), after LAG member selection and offload
+ * resolution. Sources are physical ports; a destination port cannot be a
+ * source, and frames leaving a destination port are never mirrored.
+ */
+#ifndef SWITCH_SIM_MIRROR_H
+#define SWITCH_SIM_MIRROR_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../common/config.h"
+#include "../hal/packet.h"
+
+/**
+ * @brief Pipeline priority of the ingress mirroring stage, ahead of the ACL
+ */
+#define MIRROR_PROCESSOR_PRIORITY   100
+
+/**
+ * @brief Shortest truncation length, an Ethernet header and a VLAN tag
+ */
+#define MIRROR_TRUNCATE_MIN         18
+
+/**
+ * @brief Directions a source is mirrored in
+ */
+typedef enum {
+    MIRROR_DIR_NONE = 0,            /**< Not a source */
+    MIRROR_DIR_INGRESS = 0x1,       /**< Frames received */
+    MIRROR_DIR_EGRESS = 0x2,        /**< Frames sent */
+    MIRROR_DIR_BOTH = 0x3
+} mirror_direction_t;
+
+/**
+ * @brief Mirror session parameters
+ */
+typedef struct {
+    port_id_t dest_port;            /**< Analyzer port, a physical port */
+    uint32_t truncate_length;       /**< Bytes of each frame copied, 0 for whole frames */
+    uint32_t sample_rate;           /**< Mirror 1 in sample_rate frames, 0 or 1 for all */
+    bool rspan;                     /**< Tag copies with rspan_vlan, for a remote analyzer */
+    vlan_id_t rspan_vlan;           /**< RSPAN VLAN */
+    uint8_t rspan_priority;         /**< 802.1p priority of the RSPAN tag */
+} mirror_session_config_t;
+
+/**
+ * @brief Mirror session counters
+ */
+typedef struct {
+    uint64_t mirrored;              /**< Copies the destination took */
+    uint64_t mirrored_bytes;        /**< Bytes of those copies, RSPAN tag included */
+    uint64_t sampled_out;           /**< Frames skipped by sampling */
+    uint64_t dropped;               /**< Copies the destination refused (congested or down) */
+    uint64_t no_buffer;             /**< Copies not made for lack of descriptors */
+} mirror_session_stats_t;
+
+/**
+ * @brief Initialize mirroring and register the ingress stage
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t mirror_init(void);
+
+/**
+ * @brief Delete every session and unregister the ingress stage
+ *
+ * Must not run concurrently with packet transmission.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t mirror_cleanup(void);
+
+/**
+ * @brief Create a mirror session without sources
+ *
+ * @param config Session parameters
+ * @param[out] session_id Session, below CONFIG_MIRROR_MAX_SESSIONS
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER (destination
+ *         not a physical port or a source of a session, truncation below
+ *         MIRROR_TRUNCATE_MIN, bad RSPAN VLAN), STATUS_RESOURCE_EXHAUSTED
+ *         if every session is in use, STATUS_NO_MEMORY
+ */
+status_t mirror_session_create(const mirror_session_config_t *config, uint32_t *session_id);
+
+/**
+ * @brief Delete a mirror session and stop mirroring its sources
+ *
+ * Returns once no copy for the session is being made.
+ *
+ * @param session_id Session
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t mirror_session_destroy(uint32_t session_id);
+
+/**
+ * @brief Set the directions a port is mirrored in by a session
+ *
+ * @param session_id Session
+ * @param port_id Source port, a physical port; mirror a LAG through its members
+ * @param direction MIRROR_DIR_* flags, MIRROR_DIR_NONE to remove the source
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND without the session,
+ *         STATUS_INVALID_PARAMETER if the port is a LAG or a session destination
+ */
+status_t mirror_session_set_port(uint32_t session_id, port_id_t port_id, mirror_direction_t direction);
+
+/**
+ * @brief Set the directions a VLAN is mirrored in by a session
+ *
+ * @param session_id Session
+ * @param vlan_id Source VLAN
+ * @param direction MIRROR_DIR_* flags, MIRROR_DIR_NONE to remove the source
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND, STATUS_INVALID_PARAMETER
+ */
+status_t mirror_session_set_vlan(uint32_t session_id, vlan_id_t vlan_id, mirror_direction_t direction);
+
+/**
+ * @brief Get the parameters of a session
+ *
+ * @param session_id Session
+ * @param[out] config Parameters
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t mirror_session_get_config(uint32_t session_id, mirror_session_config_t *config);
+
+/**
+ * @brief Get the counters of a session
+ *
+ * @param session_id Session
+ * @param[out] stats Counters since the session was created or last cleared
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t mirror_session_get_stats(uint32_t session_id, mirror_session_stats_t *stats);
+
+/**
+ * @brief Clear the counters of a session
+ *
+ * @param session_id Session
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t mirror_session_clear_stats(uint32_t session_id);
+
+/**
+ * @brief Mirror frames about to leave a port, where any session asks for it
+ *
+ * Called by the port transmit paths; costs a few loads when nothing on
+ * the port is mirrored. The frames stay the caller's and are not changed.
+ *
+ * @param port_id Physical egress port
+ * @param pkts Frames as they leave
+ * @param count Number of frames
+ */
+void mirror_egress_burst(port_id_t port_id, packet_buffer_t *const *pkts, uint32_t count);
+
+#endif /* SWITCH_SIM_MIRROR_H */
@@ -0,0 +1,138 @@
+/**
+ * @file storm_control.h
+ * @brief Broadcast, multicast and unknown-unicast storm control
+ *
+ * Storm control limits how many flooded frames a port or a VLAN may
+ * inject per second, so replication work stays bounded when a loop or
+ * a misbehaving host floods the switch. Every policer is a token bucket
+ * with a packet rate and a byte rate; a flood is admitted only if both
+ * the ingress port's and the VLAN's buckets for its traffic class have
+ * room.
+ *
+ * Each bucket is kept as a single 64-bit time value and updated with one
+ * compare-and-swap, so forwarding workers police concurrently without a
+ * lock and without per-worker rate splitting.
+ */
+#ifndef SWITCH_SIM_STORM_CONTROL_H
+#define SWITCH_SIM_STORM_CONTROL_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../hal/packet.h"
+
+/**
+ * @brief Class of flooded traffic
+ */
+typedef enum {
+    STORM_TYPE_BROADCAST = 0,       /**< Destination ff:ff:ff:ff:ff:ff */
+    STORM_TYPE_MULTICAST,           /**< Group destination other than broadcast */
+    STORM_TYPE_UNKNOWN_UNICAST,     /**< Unicast destination not in the MAC table */
+    STORM_TYPE_COUNT
+} storm_type_t;
+
+/**
+ * @brief Storm control limits for one traffic class
+ *
+ * A rate of 0 disables that limit. Bursts of 0 default to one second's
+ * worth of the rate.
+ */
+typedef struct {
+    uint64_t pps;                   /**< Packets per second */
+    uint64_t bps;                   /**< Bytes per second */
+    uint32_t burst_packets;         /**< Packet bucket depth */
+    uint32_t burst_bytes;           /**< Byte bucket depth */
+} storm_limit_t;
+
+/**
+ * @brief Storm control drop counters
+ */
+typedef struct {
+    uint64_t dropped_packets;       /**< Flooded frames dropped by policers */
+    uint64_t dropped_bytes;         /**< Bytes of those frames */
+} storm_counters_t;
+
+/**
+ * @brief Initialize storm control with every limit disabled
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t storm_control_init(void);
+
+/**
+ * @brief Free storm control state
+ *
+ * Must not run concurrently with storm_control_admit().
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t storm_control_cleanup(void);
+
+/**
+ * @brief Set the limit of a traffic class on an ingress port
+ *
+ * @param port_id Ingress port
+ * @param type Traffic class
+ * @param limit Limits, NULL to disable
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t storm_control_set_port(port_id_t port_id, storm_type_t type, const storm_limit_t *limit);
+
+/**
+ * @brief Set the limit of a traffic class in a VLAN
+ *
+ * @param vlan_id VLAN ID
+ * @param type Traffic class
+ * @param limit Limits, NULL to disable
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t storm_control_set_vlan(vlan_id_t vlan_id, storm_type_t type, const storm_limit_t *limit);
+
+/**
+ * @brief Classify a frame that is about to be flooded
+ *
+ * @param packet Frame
+ * @return Traffic class by destination MAC
+ */
+storm_type_t storm_control_classify(const packet_buffer_t *packet);
+
+/**
+ * @brief Police a frame before it is flooded
+ *
+ * Charges the frame to the in_port and vlan_id buckets of its class.
+ * A dropped frame is counted against the VLAN and the port, and as a
+ * PACKET_DROP_STORM_CONTROL drop; it consumes no tokens.
+ *
+ * @param in_port Ingress port, or PORT_ID_INVALID for locally originated frames
+ * @param vlan_id VLAN the frame is flooded in
+ * @param packet Frame
+ * @return true if the frame may be flooded
+ */
+bool storm_control_admit(port_id_t in_port, vlan_id_t vlan_id, packet_buffer_t *packet);
+
+/**
+ * @brief Get the storm control drop counters of a VLAN
+ *
+ * @param vlan_id VLAN ID
+ * @param[out] counters Drop counters summed over all traffic classes
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t storm_control_get_vlan_counters(vlan_id_t vlan_id, storm_counters_t *counters);
+
+/**
+ * @brief Get the storm control drop counters of an ingress port
+ *
+ * @param port_id Port ID
+ * @param[out] counters Drop counters summed over all traffic classes
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t storm_control_get_port_counters(port_id_t port_id, storm_counters_t *counters);
+
+/**
+ * @brief Clear the storm control drop counters of a VLAN
+ *
+ * @param vlan_id VLAN ID
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t storm_control_clear_vlan_counters(vlan_id_t vlan_id);
+
+#endif /* SWITCH_SIM_STORM_CONTROL_H */
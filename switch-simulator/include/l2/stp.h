@@ -181,6 +181,9 @@ status_t stp_get_port_state(port_id_t port_id, vlan_id_t vlan_id, stp_port_state
 /**
  * @brief Set state for a specific VLAN on a port
  *
+ * Sets the state of the MSTI the VLAN is mapped to, so it applies to
+ * every VLAN of that instance.
+ *
  * @param port_id Port ID
  * @param vlan_id VLAN ID
  * @param state New port state for this VLAN
@@ -189,6 +192,68 @@ status_t stp_get_port_state(port_id_t port_id, vlan_id_t vlan_id, stp_port_state
  */
 status_t stp_set_port_vlan_state(port_id_t port_id, uint16_t vlan_id, stp_port_state_t state);
 
+/**
+ * @brief Maximum number of MST instances (MSTIs)
+ *
+ * Instance 0 is the CIST; VLANs not mapped to an MSTI belong to it.
+ */
+#define STP_MAX_MSTI 64
+#define STP_CIST_ID  0
+
+/**
+ * @brief Map a VLAN to an MST instance
+ *
+ * @param vlan_id VLAN ID
+ * @param msti_id MSTI (1-STP_MAX_MSTI), or STP_CIST_ID to return the VLAN to the CIST
+ * @return status_t STATUS_SUCCESS on success
+ */
+status_t stp_set_vlan_instance(vlan_id_t vlan_id, uint16_t msti_id);
+
+/**
+ * @brief Get the MST instance a VLAN is mapped to
+ *
+ * @param vlan_id VLAN ID
+ * @param msti_id Output parameter to store the instance
+ * @return status_t STATUS_SUCCESS on success
+ */
+status_t stp_get_vlan_instance(vlan_id_t vlan_id, uint16_t *msti_id);
+
+/**
+ * @brief Get the state of a port in an MST instance
+ *
+ * MSTIs only distinguish blocking (discarding), learning and forwarding.
+ *
+ * @param port_id Port identifier
+ * @param msti_id Instance, STP_CIST_ID for the CIST
+ * @param state Output parameter to store the state
+ * @return status_t STATUS_SUCCESS on success
+ */
+status_t stp_get_port_instance_state(port_id_t port_id, uint16_t msti_id, stp_port_state_t *state);
+
+/**
+ * @brief Set the state of a port in an MSTI
+ *
+ * The CIST state is computed by the protocol and cannot be set.
+ *
+ * @param port_id Port identifier
+ * @param msti_id Instance (1-STP_MAX_MSTI)
+ * @param state New state
+ * @return status_t STATUS_SUCCESS on success
+ */
+status_t stp_set_port_instance_state(port_id_t port_id, uint16_t msti_id, stp_port_state_t state);
+
+/**
+ * @brief Check if a port forwards frames of a VLAN
+ *
+ * Lockless: one load of the VLAN's instance and one of the port's
+ * packed instance states.
+ *
+ * @param port_id Port identifier
+ * @param vlan_id VLAN ID
+ * @return true if STP is disabled or the port forwards in the VLAN's instance
+ */
+bool stp_can_forward(port_id_t port_id, vlan_id_t vlan_id);
+
 /**
  * @brief Get current STP role for a port
  * 
@@ -198,6 +263,18 @@ status_t stp_set_port_vlan_state(port_id_t port_id, uint16_t vlan_id, stp_port_s
  */
 status_t stp_get_port_role(port_id_t port_id, stp_port_role_t *role);
 
+/**
+ * @brief Mark a port as an edge port
+ *
+ * With RSTP an edge port forwards as soon as it comes up. It loses edge
+ * status when it receives a BPDU and regains it on the next link up.
+ *
+ * @param port_id Port identifier
+ * @param edge true for an edge port
+ * @return status_t STATUS_SUCCESS on success
+ */
+status_t stp_set_port_edge(port_id_t port_id, bool edge);
+
 /**
  * @brief Get STP statistics for a port
  * 
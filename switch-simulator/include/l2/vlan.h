@@ -8,6 +8,8 @@
 
 #include "../common/types.h"
 #include "../common/error_codes.h"
+#include "../common/config.h"
+#include "../common/table_cursor.h"
 #include "../hal/port.h"
 
 #define MAX_VLANS 4096
@@ -22,6 +24,19 @@
 #define DEFAULT_VLAN        1
 #define VLAN_ID_INVALID     0
 
+/** Number of 64-bit words in a port bitmap */
+#define VLAN_PORT_WORDS CONFIG_PORT_BITMAP_WORDS
+
+/**
+ * @brief Port bitmap, one bit per port packed into 64-bit words
+ */
+typedef struct {
+    uint64_t w[VLAN_PORT_WORDS];
+} vlan_port_bitmap_t;
+
+/** Number of 64-bit words in a VLAN ID bitmap (bit n set means VLAN n) */
+#define VLAN_ID_WORDS (MAX_VLANS / 64)
+
 typedef enum {
     VLAN_PORT_MODE_ACCESS = 0,  /**< Access port - untagged for one VLAN */
     VLAN_PORT_MODE_TRUNK,       /**< Trunk port - tagged for multiple VLANs */
@@ -33,6 +48,19 @@ typedef enum {
     VLAN_MEMBER_UNTAGGED       /**< Untagged member - frames sent without VLAN tag */
 } vlan_member_type_t;
 
+/**
+ * @brief 802.1ad (QinQ) role of a port
+ *
+ * Frames received on QinQ ports are classified to an S-VLAN and carry an
+ * S-tag (ETHERTYPE_QINQ) as their outer tag inside the switch, so the
+ * usual tagged/untagged egress rules add, keep or strip the S-tag.
+ */
+typedef enum {
+    VLAN_QINQ_NONE = 0,        /**< 802.1Q port, classifies on the outer tag of either TPID */
+    VLAN_QINQ_CUSTOMER,        /**< Customer edge: untagged and C-tagged frames get an S-tag */
+    VLAN_QINQ_PROVIDER         /**< Provider network: classifies on the S-tag, sends S-tagged */
+} vlan_qinq_mode_t;
+
 typedef struct {
     vlan_id_t      vlan_id;                 /**< VLAN identifier (1-4095) */
     //char           name[32];              /**< VLAN name */
@@ -81,6 +109,21 @@ status_t vlan_get_port_config(port_id_t port_id, vlan_port_config_t *config);
 
 status_t vlan_get_all(vlan_entry_t *entries, uint32_t max_entries, uint32_t *count);
 
+status_t vlan_get_active_vlans(vlan_id_t *vlan_list, uint32_t max_vlans, uint32_t *num_vlans);
+
+/**
+ * @brief Get the next page of active VLAN IDs, in ascending order
+ *
+ * @param cursor TABLE_CURSOR_START to begin; moved past the VLANs
+ *               returned, TABLE_CURSOR_END once every VLAN was looked at
+ * @param vlan_list Output array to store VLAN IDs
+ * @param max_vlans Size of the array
+ * @param num_vlans Output parameter to store the number of VLANs returned
+ * @return status_t Status code
+ */
+status_t vlan_get_active_vlans_page(table_cursor_t *cursor, vlan_id_t *vlan_list, uint32_t max_vlans,
+                                    uint32_t *num_vlans);
+
 status_t vlan_get_by_port(port_id_t port_id, vlan_id_t *vlan_ids, uint32_t max_vlans, uint32_t *count);
 
 typedef enum {
@@ -123,5 +166,301 @@ status_t vlan_register_event_callback(vlan_event_callback_t callback, void *user
  */
 status_t vlan_process_egress(const packet_buffer_t *packet, vlan_id_t vlan_id, port_id_t out_port, packet_buffer_t *out_packet);
 
+/**
+ * @brief Apply egress VLAN tagging for a port to a packet in place
+ *
+ * Pushes (into headroom), pops or rewrites the outer 802.1Q tag so the
+ * frame matches what out_port needs for vlan_id. Nothing is touched
+ * when the tag state already matches. Shared data is copied first.
+ *
+ * @param packet Packet to modify
+ * @param vlan_id VLAN ID associated with the packet
+ * @param out_port Port on which the packet will be sent
+ * @return status_t Status code
+ */
+status_t vlan_process_egress_inplace(packet_buffer_t *packet, vlan_id_t vlan_id, port_id_t out_port);
+
+/**
+ * @brief Egress buffers for flooding a frame in a VLAN
+ *
+ * Ports are grouped by tagging requirement and each group shares one
+ * buffer, so a flood needs at most two differently tagged copies no
+ * matter how many ports it reaches. Tagged ports with an egress VID
+ * translation for the VLAN are listed separately; each of them needs its
+ * own copy of the frame passed through vlan_process_egress_inplace().
+ */
+typedef struct {
+    vlan_port_bitmap_t tagged_ports;    /**< Ports that get the tagged buffer */
+    vlan_port_bitmap_t untagged_ports;  /**< Ports that get the untagged buffer */
+    vlan_port_bitmap_t translated_ports; /**< Tagged ports that send the VLAN under another VID */
+    packet_buffer_t *tagged;            /**< Tagged frame, NULL if tagged_ports is empty */
+    packet_buffer_t *untagged;          /**< Untagged frame, NULL if untagged_ports is empty */
+    packet_buffer_t *clone;             /**< Buffer allocated for the second group, NULL if none */
+} vlan_flood_t;
+
+/**
+ * @brief Prepare the egress buffers for flooding a frame in a VLAN
+ *
+ * The egress ports are the VLAN's flood mask without in_port. The
+ * original packet is reused (retagged in place) for one group; the other
+ * group gets a shared clone that is retagged, which copies the data once.
+ * The caller keeps ownership of packet and must call vlan_flood_release().
+ * Frames over the ingress port's or the VLAN's storm control limit are
+ * not replicated: all groups are left empty and STATUS_RESOURCE_EXCEEDED
+ * is returned.
+ *
+ * @param packet Frame to flood
+ * @param vlan_id VLAN ID of the frame
+ * @param in_port Ingress port, or PORT_ID_INVALID
+ * @param flood Output egress groups and buffers
+ * @return status_t Status code
+ */
+status_t vlan_flood_prepare(packet_buffer_t *packet, vlan_id_t vlan_id, port_id_t in_port, vlan_flood_t *flood);
+
+/**
+ * @brief Free the buffer allocated by vlan_flood_prepare()
+ *
+ * @param flood Flood state
+ */
+void vlan_flood_release(vlan_flood_t *flood);
+
+/**
+ * @brief Get the ports a frame received on a VLAN should be flooded to
+ *
+ * The result is the VLAN's precomputed flood mask (members that are STP
+ * forwarding and link-up) minus the ingress port.
+ *
+ * @param vlan_id VLAN ID
+ * @param in_port Ingress port, or PORT_ID_INVALID for locally originated frames
+ * @param ports Output bitmap of egress ports
+ * @return status_t STATUS_SUCCESS, or STATUS_NOT_FOUND if the VLAN does not exist
+ */
+status_t vlan_get_flood_ports(vlan_id_t vlan_id, port_id_t in_port, vlan_port_bitmap_t *ports);
+
+/**
+ * @brief Set whether STP allows a port to forward frames
+ *
+ * @param port_id Port ID
+ * @param forwarding True if the port is in the forwarding state
+ * @return status_t Status code
+ */
+status_t vlan_set_port_forwarding(port_id_t port_id, bool forwarding);
+
+/**
+ * @brief Set the link state of a port for flood mask computation
+ *
+ * @param port_id Port ID
+ * @param link_up True if the port link is up
+ * @return status_t Status code
+ */
+status_t vlan_set_port_link(port_id_t port_id, bool link_up);
+
+/**
+ * @brief Create every VLAN in [first_vlan, last_vlan] in one operation
+ *
+ * The whole range is checked before anything is changed: if any VLAN in
+ * it already exists nothing is created. VLANs get their default names.
+ *
+ * @param first_vlan First VLAN ID of the range
+ * @param last_vlan Last VLAN ID of the range (inclusive)
+ * @return status_t STATUS_SUCCESS, ERROR_INVALID_PARAMETER for a bad range,
+ *         or STATUS_ALREADY_EXISTS if a VLAN in the range exists
+ */
+status_t vlan_create_range(vlan_id_t first_vlan, vlan_id_t last_vlan);
+
+/**
+ * @brief Add a set of ports to every VLAN in [first_vlan, last_vlan]
+ *
+ * Equivalent to calling vlan_add_port() for each port and VLAN, but the
+ * lock is taken once and each port's classification is rebuilt once.
+ * Nothing is changed unless every VLAN exists and every port is valid.
+ *
+ * @param first_vlan First VLAN ID of the range
+ * @param last_vlan Last VLAN ID of the range (inclusive)
+ * @param ports Ports to add
+ * @param member_type Type of VLAN membership (tagged or untagged)
+ * @return status_t Status code
+ */
+status_t vlan_add_ports_bitmap(vlan_id_t first_vlan, vlan_id_t last_vlan,
+                               const vlan_port_bitmap_t *ports, vlan_member_type_t member_type);
+
+/**
+ * @brief One port's membership of one VLAN, for the bulk calls below
+ */
+typedef struct {
+    vlan_id_t vlan_id;               /**< VLAN ID */
+    port_id_t port_id;               /**< Port ID */
+    vlan_member_type_t member_type;  /**< Tagged or untagged; ignored on removal */
+} vlan_member_t;
+
+/**
+ * @brief Add a list of VLAN memberships
+ *
+ * Same as vlan_add_port() for each membership, in order, but the lock is
+ * taken once and each VLAN and port touched is rebuilt once.
+ *
+ * @param members Memberships to add
+ * @param count Number of memberships
+ * @param stop_on_error Stop at the first membership that fails
+ * @param statuses Status of each membership, may be NULL; STATUS_NOT_EXECUTED
+ *                 for memberships not tried
+ * @return status_t STATUS_SUCCESS, or the error of the last membership that failed
+ */
+status_t vlan_add_members_bulk(const vlan_member_t *members, uint32_t count, bool stop_on_error,
+                               status_t *statuses);
+
+/**
+ * @brief Remove a list of VLAN memberships
+ *
+ * Same as vlan_remove_port() for each membership, with the lock taken once.
+ *
+ * @param members Memberships to remove
+ * @param count Number of memberships
+ * @param stop_on_error Stop at the first membership that fails
+ * @param statuses Status of each membership, may be NULL; STATUS_NOT_EXECUTED
+ *                 for memberships not tried
+ * @return status_t STATUS_SUCCESS, or the error of the last membership that failed
+ */
+status_t vlan_remove_members_bulk(const vlan_member_t *members, uint32_t count, bool stop_on_error,
+                                  status_t *statuses);
+
+/**
+ * @brief Replace the allowed VLAN set of a trunk or hybrid port
+ *
+ * Bit 0 is ignored. The native VLAN of the port must stay allowed.
+ *
+ * @param port_id Port ID
+ * @param bitmap VLAN ID bitmap of VLAN_ID_WORDS words
+ * @return status_t Status code
+ */
+status_t vlan_set_trunk_allowed_bitmap(port_id_t port_id, const uint64_t *bitmap);
+
+/**
+ * @brief Get the set of active VLANs
+ *
+ * @param bitmap Output VLAN ID bitmap of VLAN_ID_WORDS words
+ * @return status_t Status code
+ */
+status_t vlan_get_active_bitmap(uint64_t *bitmap);
+
+/**
+ * @brief Get the member ports of a VLAN as bitmaps
+ *
+ * @param vlan_id VLAN ID
+ * @param members Output bitmap of all member ports, may be NULL
+ * @param untagged Output bitmap of untagged member ports, may be NULL
+ * @return status_t STATUS_SUCCESS, STATUS_NOT_FOUND if the VLAN is not active
+ */
+status_t vlan_get_member_bitmaps(vlan_id_t vlan_id, vlan_port_bitmap_t *members,
+                                 vlan_port_bitmap_t *untagged);
+
+/**
+ * @brief Set the QinQ role of a port
+ *
+ * @param port_id Port ID
+ * @param mode QinQ role
+ * @return status_t Status code
+ */
+status_t vlan_set_port_qinq_mode(port_id_t port_id, vlan_qinq_mode_t mode);
+
+/**
+ * @brief Map a C-VLAN to an S-VLAN on a customer edge port
+ *
+ * C-tagged frames whose C-VID has no mapping are classified to the port's
+ * PVID. The table is a flat array indexed by C-VID.
+ *
+ * @param port_id Port ID
+ * @param c_vlan Customer VLAN ID
+ * @param s_vlan Service VLAN ID, or VLAN_ID_INVALID to remove the mapping
+ * @return status_t Status code
+ */
+status_t vlan_set_svlan_translation(port_id_t port_id, vlan_id_t c_vlan, vlan_id_t s_vlan);
+
+/**
+ * @brief Classify an incoming packet without changing it
+ *
+ * Lock-free; reads the port's published classification record.
+ *
+ * @param port_id Port on which the packet was received
+ * @param packet Packet to classify
+ * @param vlan_id Output VLAN
+ * @return status_t STATUS_SUCCESS, or ERROR_INVALID_PACKET if the frame is dropped
+ */
+status_t vlan_get_packet_vlan(port_id_t port_id, const packet_buffer_t *packet, vlan_id_t *vlan_id);
+
+/**
+ * @brief Classify an incoming packet and normalize its outer tag in place
+ *
+ * Same classification as vlan_get_packet_vlan(). On QinQ ports the frame
+ * additionally gets an S-tag for the classified S-VLAN if its outer tag
+ * is not one already, pushed into headroom without copying the payload.
+ *
+ * @param port_id Port on which the packet was received
+ * @param packet Packet to classify
+ * @param vlan_id Output VLAN (S-VLAN on QinQ ports)
+ * @return status_t STATUS_SUCCESS, or ERROR_INVALID_PACKET if the frame is dropped
+ */
+status_t vlan_process_ingress_inplace(port_id_t port_id, packet_buffer_t *packet, vlan_id_t *vlan_id);
+
+/**
+ * @brief Translate a received VID to a VLAN on a port
+ *
+ * Tagged frames received on the port with wire_vid are classified into
+ * vlan_id, which must then pass the port's usual membership checks. The
+ * table is a direct-indexed array, so translation costs one load during
+ * classification. Not applied on QinQ customer edge ports, which use the
+ * S-VLAN table instead.
+ *
+ * @param port_id Port ID
+ * @param wire_vid VID as received on the wire
+ * @param vlan_id Internal VLAN ID, or VLAN_ID_INVALID to remove the entry
+ * @return status_t Status code
+ */
+status_t vlan_set_ingress_translation(port_id_t port_id, vlan_id_t wire_vid, vlan_id_t vlan_id);
+
+/**
+ * @brief Translate a VLAN to a transmitted VID on a port
+ *
+ * Frames of vlan_id that leave the port tagged carry wire_vid instead.
+ * The entry is dropped when the VLAN is deleted.
+ *
+ * @param port_id Port ID
+ * @param vlan_id Internal VLAN ID
+ * @param wire_vid VID to transmit, or VLAN_ID_INVALID to remove the entry
+ * @return status_t Status code
+ */
+status_t vlan_set_egress_translation(port_id_t port_id, vlan_id_t vlan_id, vlan_id_t wire_vid);
+
+/**
+ * @brief Traffic counters of a VLAN
+ */
+typedef struct {
+    uint64_t rx_packets;    /**< Frames classified into the VLAN */
+    uint64_t rx_bytes;
+    uint64_t tx_packets;    /**< Frames prepared for egress, flood copies included */
+    uint64_t tx_bytes;
+} vlan_counters_t;
+
+/**
+ * @brief Get the traffic counters of a VLAN
+ *
+ * The data path counts in per-thread shards; this folds them. Only the
+ * process's own switch counts; other switch instances (topology.h) get
+ * STATUS_NOT_SUPPORTED.
+ *
+ * @param vlan_id VLAN ID
+ * @param counters Output counters since the last clear
+ * @return status_t Status code
+ */
+status_t vlan_get_counters(vlan_id_t vlan_id, vlan_counters_t *counters);
+
+/**
+ * @brief Clear the traffic counters of a VLAN
+ *
+ * @param vlan_id VLAN ID
+ * @return status_t Status code
+ */
+status_t vlan_clear_counters(vlan_id_t vlan_id);
+
 
 #endif /* SWITCH_SIM_VLAN_H */
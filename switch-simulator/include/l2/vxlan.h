@@ -0,0 +1,268 @@
+/**
+ * @file vxlan.h
+ * @brief VXLAN tunnel endpoint (RFC 7348)
+ *
+ * A switch with a local VTEP address carries VLANs over an IP underlay:
+ * each VLAN mapped to a VXLAN network identifier (VNI) is extended to
+ * the remote VTEPs its frames are sent to. A tunnel to a remote VTEP is
+ * a logical port: tunnel n has port ID VXLAN_PORT_ID(n), the MAC table
+ * learns the addresses behind a remote VTEP on its tunnel port, and a
+ * frame whose destination was learned there is encapsulated and sent
+ * over the tunnel's underlay port instead of being retagged.
+ *
+ * Encapsulation pushes the 50 bytes of outer Ethernet, IPv4, UDP and
+ * VXLAN headers in front of the inner frame. The headers of each tunnel
+ * are built once into a template when the tunnel or the VTEP changes,
+ * with the IPv4 header sum precomputed without the length; sending a
+ * frame copies the template and patches the IPv4 and UDP lengths, the
+ * IPv4 checksum, the UDP source port (a hash of the inner flow, for
+ * ECMP in the underlay) and the VNI. An exclusive frame gets its outer
+ * headers in place, in its headroom; a flooded frame gets a small header
+ * segment in front of a shared slice of the inner frame, so head-end
+ * replication to many VTEPs copies no payload. Inner frames are carried
+ * without their outer VLAN tag; the UDP checksum is zero.
+ *
+ * VNI to VLAN and VLAN to VNI are direct-indexed tables: a two-level
+ * table of 4096-entry pages for the 24-bit VNI, allocated on first use,
+ * and one VNI per VLAN. Broadcast, unknown unicast and multicast go to
+ * the tunnels on the VLAN's flood list. Frames received from a tunnel
+ * are never sent back into a tunnel (split horizon), as the remote VTEPs
+ * replicate to their own ports and the overlay is a full mesh.
+ *
+ * Tunnels are static: the remote VTEP, the underlay port and the MAC of
+ * the underlay next hop are configured, not resolved. State is per
+ * switch instance (switch_context.h); the topology engine calls the
+ * data path functions.
+ */
+#ifndef SWITCH_SIM_VXLAN_H
+#define SWITCH_SIM_VXLAN_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../common/config.h"
+#include "../hal/packet.h"
+
+/**
+ * @brief Port ID of tunnel index
+ */
+#define VXLAN_PORT_ID(index) ((port_id_t)(CONFIG_VXLAN_PORT_BASE + (index)))
+
+#define VXLAN_UDP_PORT          4789    /**< IANA port */
+#define VXLAN_HDR_LEN           8       /**< VXLAN header */
+#define VXLAN_ENCAP_LEN         50      /**< Outer Ethernet, IPv4, UDP and VXLAN headers */
+#define VXLAN_VNI_MAX           0xFFFFFF
+#define VXLAN_DEFAULT_TTL       64
+
+/**
+ * @brief Tunnel to one remote VTEP
+ */
+typedef struct {
+    uint32_t remote_ip;             /**< IPv4 address of the remote VTEP, host order */
+    port_id_t underlay_port;        /**< Port or LAG the tunnel is sent over */
+    mac_addr_t next_hop_mac;        /**< Destination MAC of the outer frames */
+    uint8_t ttl;                    /**< Outer TTL, 0 for VXLAN_DEFAULT_TTL */
+    uint8_t dscp;                   /**< Outer DSCP */
+} vxlan_tunnel_config_t;
+
+/**
+ * @brief Counters of one tunnel
+ */
+typedef struct {
+    uint64_t encap_packets;         /**< Frames sent into the tunnel */
+    uint64_t encap_bytes;           /**< Bytes of those frames, outer headers included */
+    uint64_t decap_packets;         /**< Frames received from the tunnel */
+    uint64_t decap_bytes;           /**< Bytes of those frames, outer headers included */
+} vxlan_tunnel_stats_t;
+
+/**
+ * @brief Counters of the VTEP
+ */
+typedef struct {
+    uint64_t unknown_vtep;          /**< Frames for the VTEP from no configured tunnel */
+    uint64_t unknown_vni;           /**< Frames with a VNI mapped to no VLAN */
+    uint64_t bad_header;            /**< Frames without the I flag or with a truncated inner frame */
+    uint64_t encap_errors;          /**< Frames that could not be encapsulated */
+} vxlan_stats_t;
+
+/**
+ * @brief Sends an encapsulated frame out of an underlay port
+ *
+ * @param underlay_port Port or LAG of the tunnel
+ * @param packet Frame, owned by the callee; its parse cache is invalid
+ * @param arg Argument given to vxlan_flood()
+ */
+typedef void (*vxlan_transmit_fn)(port_id_t underlay_port, packet_buffer_t *packet, void *arg);
+
+/**
+ * @brief Whether a port ID belongs to a tunnel, created or not
+ */
+static inline bool vxlan_port_is_tunnel(port_id_t port_id) {
+    return port_id >= CONFIG_VXLAN_PORT_BASE && port_id < CONFIG_VXLAN_PORT_BASE + CONFIG_VXLAN_MAX_TUNNELS;
+}
+
+/**
+ * @brief Initialize the VTEP of the current switch instance, without an address
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t vxlan_init(void);
+
+/**
+ * @brief Delete every tunnel and mapping and free the state of the current instance
+ *
+ * Must not run concurrently with the data path calls.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t vxlan_deinit(void);
+
+/**
+ * @brief Set the local VTEP
+ *
+ * Frames for another address or MAC are bridged as any other frame.
+ *
+ * @param local_ip IPv4 source address of the tunnels, host order; 0 disables the VTEP
+ * @param local_mac Source MAC of the outer frames
+ * @param udp_port UDP destination port, 0 for VXLAN_UDP_PORT
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t vxlan_set_vtep(uint32_t local_ip, const mac_addr_t *local_mac, uint16_t udp_port);
+
+/**
+ * @brief Create a tunnel to a remote VTEP
+ *
+ * @param tunnel_port Port ID, VXLAN_PORT_ID(n) for n below CONFIG_VXLAN_MAX_TUNNELS
+ * @param config Tunnel parameters
+ * @return STATUS_SUCCESS on success, STATUS_ALREADY_EXISTS if the tunnel
+ *         exists, STATUS_RESOURCE_BUSY if another tunnel has the remote
+ *         VTEP, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t vxlan_tunnel_create(port_id_t tunnel_port, const vxlan_tunnel_config_t *config);
+
+/**
+ * @brief Delete a tunnel
+ *
+ * Flushes the MAC entries learned on the tunnel and removes it from
+ * every flood list.
+ *
+ * @param tunnel_port Tunnel
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if there is no such tunnel
+ */
+status_t vxlan_tunnel_delete(port_id_t tunnel_port);
+
+/**
+ * @brief Get the parameters of a tunnel
+ *
+ * @param tunnel_port Tunnel
+ * @param[out] config Parameters
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t vxlan_tunnel_get_config(port_id_t tunnel_port, vxlan_tunnel_config_t *config);
+
+/**
+ * @brief Get the counters of a tunnel
+ *
+ * @param tunnel_port Tunnel
+ * @param[out] stats Counters since the tunnel was created
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t vxlan_tunnel_get_stats(port_id_t tunnel_port, vxlan_tunnel_stats_t *stats);
+
+/**
+ * @brief Map a VNI to a VLAN
+ *
+ * @param vni VXLAN network identifier, 1 to VXLAN_VNI_MAX
+ * @param vlan_id VLAN the VNI's frames are bridged in
+ * @return STATUS_SUCCESS on success, STATUS_RESOURCE_BUSY if the VNI or
+ *         the VLAN is mapped already, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t vxlan_map_vni(uint32_t vni, vlan_id_t vlan_id);
+
+/**
+ * @brief Remove the mapping of a VNI
+ *
+ * @param vni VXLAN network identifier
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if the VNI is not mapped
+ */
+status_t vxlan_unmap_vni(uint32_t vni);
+
+/**
+ * @brief VNI a VLAN is carried in
+ *
+ * Lock-free.
+ *
+ * @param vlan_id VLAN
+ * @return VNI, 0 if the VLAN is not mapped
+ */
+uint32_t vxlan_vlan_vni(vlan_id_t vlan_id);
+
+/**
+ * @brief Add a tunnel to or remove it from the flood list of a VLAN
+ *
+ * @param tunnel_port Tunnel
+ * @param vlan_id VLAN, which needs a VNI before frames are flooded
+ * @param flood Replicate the VLAN's broadcast, unknown unicast and multicast to the tunnel
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND, STATUS_INVALID_PARAMETER
+ */
+status_t vxlan_set_flood(port_id_t tunnel_port, vlan_id_t vlan_id, bool flood);
+
+/**
+ * @brief Take the inner frame out of a VXLAN frame for the local VTEP
+ *
+ * Lock-free. A frame for the VTEP is one to its MAC and address and to
+ * its UDP port. The outer headers are pulled off and the inner frame is
+ * parsed.
+ *
+ * @param packet Frame, parsed (packet_parse())
+ * @param[out] tunnel_port Tunnel the frame came from
+ * @param[out] vlan_id VLAN of the frame's VNI
+ * @return STATUS_SUCCESS if decapsulated, STATUS_NOT_FOUND if the frame
+ *         is not for the VTEP and is bridged as is; any other code if the
+ *         frame is for the VTEP but must be dropped (an unknown remote
+ *         VTEP or VNI, a bad VXLAN header)
+ */
+status_t vxlan_decap(packet_buffer_t *packet, port_id_t *tunnel_port, vlan_id_t *vlan_id);
+
+/**
+ * @brief Encapsulate a frame for a tunnel in place
+ *
+ * Lock-free. Drops the frame's outer VLAN tag and pushes the outer
+ * headers, in the headroom when there is room and the data is not shared.
+ *
+ * @param packet Frame, parsed
+ * @param tunnel_port Tunnel
+ * @param vlan_id VLAN of the frame, which selects the VNI
+ * @param[out] underlay_port Port or LAG to send the frame out of
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND without the tunnel
+ *         or a VNI for the VLAN, STATUS_NO_MEMORY; the frame stays the
+ *         caller's either way
+ */
+status_t vxlan_encap(packet_buffer_t *packet, port_id_t tunnel_port, vlan_id_t vlan_id,
+                     port_id_t *underlay_port);
+
+/**
+ * @brief Replicate a frame to the tunnels on its VLAN's flood list
+ *
+ * Lock-free. Each copy is a header segment chained to a shared slice of
+ * the frame, which is left as it is. Nothing is sent for a frame
+ * received from a tunnel.
+ *
+ * @param packet Frame, parsed
+ * @param vlan_id VLAN of the frame
+ * @param in_port Port the frame was received on
+ * @param transmit Sends each copy
+ * @param arg Argument of transmit
+ * @return Number of copies sent
+ */
+uint32_t vxlan_flood(packet_buffer_t *packet, vlan_id_t vlan_id, port_id_t in_port,
+                     vxlan_transmit_fn transmit, void *arg);
+
+/**
+ * @brief Get the counters of the VTEP
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t vxlan_get_stats(vxlan_stats_t *stats);
+
+#endif /* SWITCH_SIM_VXLAN_H */
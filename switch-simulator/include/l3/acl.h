@@ -0,0 +1,253 @@
+/**
+ * @file acl.h
+ * @brief Compiled access control lists for routed and bridged IP traffic
+ *
+ * A rule set is an ordered list of rules over the IP 5-tuple, ingress
+ * port and VLAN; the first rule a packet matches decides its fate and
+ * packets matching none get the rule set's default action. The list is
+ * compiled into a tuple space classifier: rules with the same shape
+ * (prefix lengths and which fields they match exactly) share one hash
+ * table, so a lookup costs one probe per shape instead of one comparison
+ * per rule. Shapes are probed in order of the best rule they hold, and a
+ * packet stops as soon as no remaining shape can beat its match.
+ *
+ * acl_set_rules() compiles the new rule set off to the side and swaps it
+ * in with one pointer store; packets never see a half-built classifier.
+ * The ACL runs as a burst stage of the packet pipeline at
+ * ACL_PROCESSOR_PRIORITY, so L2 stages register below that priority and
+ * L3 stages above it. Hit counters are kept per forwarding thread. A
+ * permit rule may name a policer, which the stage charges with the
+ * packets the rule matches; packets it colors for dropping are dropped.
+ *
+ * Policy-based routing uses the same classifier. A PBR policy is a rule
+ * set whose rules either redirect a flow to a next-hop group
+ * (ACL_ACTION_REDIRECT) or leave it to the FIB (ACL_ACTION_PERMIT); it is
+ * attached to ingress ports, and IP forwarding consults it in place of
+ * the routing table lookup for packets received on those ports. Ports
+ * without a policy cost one load of their attachment and nothing else.
+ */
+#ifndef SWITCH_SIM_ACL_H
+#define SWITCH_SIM_ACL_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../common/config.h"
+#include "../hal/packet.h"
+#include "../hal/port_types.h"
+#include "ip.h"
+
+/**
+ * @brief Most rules in one rule set; rule IDs are below this value
+ */
+#define ACL_MAX_RULES 4096
+
+/**
+ * @brief Pipeline priority of the ACL stage
+ */
+#define ACL_PROCESSOR_PRIORITY 500
+
+#define ACL_PBR_MAX_POLICIES    64          /**< PBR policy IDs are below this value */
+#define ACL_PBR_MAX_GROUPS      1024        /**< PBR next-hop groups are 1 to this value */
+#define ACL_PBR_MAX_PATHS       16          /**< Paths in one PBR next-hop group */
+#define ACL_PBR_NONE            UINT32_MAX  /**< Policy ID that detaches a port */
+
+/**
+ * @brief What happens to a packet matching a rule
+ */
+typedef enum {
+    ACL_ACTION_PERMIT = 0,          /**< Continue through the pipeline */
+    ACL_ACTION_DENY,                /**< Drop */
+    ACL_ACTION_REDIRECT             /**< PBR policies only: route to the rule's next-hop group */
+} acl_action_t;
+
+/**
+ * @brief One ACL rule
+ *
+ * Source and destination are prefixes of the same family, IPv4 addresses
+ * in network byte order as they appear in the header. A port range
+ * of 0..65535 matches any packet; any other range only matches TCP and
+ * UDP packets that carry ports, so non-first fragments never match it.
+ */
+typedef struct {
+    uint32_t rule_id;               /**< Unique in the set, below ACL_MAX_RULES; keys the hit counter */
+    ip_addr_t src_addr;             /**< Source prefix, its type is the family matched */
+    uint8_t src_prefix_len;         /**< Source prefix length, 0 for any */
+    ip_addr_t dst_addr;             /**< Destination prefix, same type as src_addr */
+    uint8_t dst_prefix_len;         /**< Destination prefix length, 0 for any */
+    uint8_t protocol;               /**< IPv4 protocol or final IPv6 next header */
+    bool match_protocol;            /**< Whether protocol is matched */
+    uint16_t src_port_min;          /**< Lowest source port */
+    uint16_t src_port_max;          /**< Highest source port */
+    uint16_t dst_port_min;          /**< Lowest destination port */
+    uint16_t dst_port_max;          /**< Highest destination port */
+    port_id_t in_port;              /**< Ingress port, PORT_ID_INVALID for any */
+    vlan_id_t vlan_id;              /**< Ingress VLAN, 0 for any */
+    acl_action_t action;            /**< Action on a match */
+    uint32_t nh_group;              /**< Next-hop group of ACL_ACTION_REDIRECT */
+    uint32_t policer_id;            /**< Policer of permitted matches (policer.h), 0 for none; not in PBR policies */
+    bool int_watch;                 /**< Stamp in-band telemetry into permitted matches (int_telemetry.h); not in PBR policies */
+} acl_rule_t;
+
+/**
+ * @brief One path of a PBR next-hop group
+ *
+ * An unspecified next hop (all zeros) sends packets to their own
+ * destination on the egress port, as a connected route does.
+ */
+typedef struct {
+    ip_addr_t next_hop;             /**< Next hop, its type is the family the group serves */
+    port_id_t egress_port;          /**< Port the path leaves on */
+} acl_pbr_path_t;
+
+/**
+ * @brief ACL verdict counters, summed over all forwarding threads
+ */
+typedef struct {
+    uint64_t permitted;             /**< IP packets let through */
+    uint64_t denied;                /**< IP packets dropped */
+    uint64_t default_hits;          /**< IP packets that matched no rule */
+    uint32_t rule_count;            /**< Rules in the active rule set */
+    uint32_t tuple_count;           /**< Distinct rule shapes the classifier probes */
+    uint64_t pbr_redirected;        /**< Packets routed by a PBR next-hop group */
+    uint64_t pbr_fallbacks;         /**< Redirected packets left to the FIB: group missing, of another family or down */
+} acl_stats_t;
+
+/** PBR policy of each ingress port, policy ID + 1, 0 for none */
+extern uint8_t g_acl_pbr_port_policy[CONFIG_MAX_PORTS];
+
+/**
+ * @brief Check if a PBR policy is attached to an ingress port
+ */
+static inline bool acl_pbr_attached(port_id_t port) {
+    return port < CONFIG_MAX_PORTS && __atomic_load_n(&g_acl_pbr_port_policy[port], __ATOMIC_RELAXED) != 0;
+}
+
+/**
+ * @brief Initialize the ACL with an empty rule set that permits everything
+ *
+ * Registers the ACL stage with the packet pipeline, which must be
+ * initialized first.
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t acl_init(void);
+
+/**
+ * @brief Remove the ACL stage and free the classifier and counters
+ *
+ * Must not run concurrently with packet processing.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t acl_cleanup(void);
+
+/**
+ * @brief Compile a rule set and make it the active one
+ *
+ * Packets already being classified finish against the old rule set.
+ * Hit counters belong to rule IDs and survive the swap.
+ *
+ * @param rules Rules, first match wins; NULL if count is 0
+ * @param count Number of rules (at most ACL_MAX_RULES)
+ * @param default_action Action for packets matching no rule
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER for a bad
+ *         rule (the active rule set is kept), STATUS_NO_MEMORY
+ */
+status_t acl_set_rules(const acl_rule_t *rules, uint32_t count, acl_action_t default_action);
+
+/**
+ * @brief Classify a burst of packets against the active rule set
+ *
+ * Packets are parsed if needed. Frames other than IPv4 and IPv6 are
+ * permitted without being counted.
+ *
+ * @param pkts Packets to classify
+ * @param count Number of packets (at most PACKET_BURST_MAX)
+ * @param[out] actions Action for each packet
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t acl_classify_burst(packet_buffer_t **pkts, uint32_t count, acl_action_t *actions);
+
+/**
+ * @brief Get the number of packets that matched a rule
+ *
+ * @param rule_id Rule ID
+ * @param[out] hits Matches summed over all forwarding threads
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t acl_get_rule_hits(uint32_t rule_id, uint64_t *hits);
+
+/**
+ * @brief Get ACL verdict counters
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t acl_get_stats(acl_stats_t *stats);
+
+/**
+ * @brief Set the paths of a PBR next-hop group
+ *
+ * Flows are spread over the paths by a hash of their 5-tuple; a path
+ * whose egress port is down is skipped.
+ *
+ * @param group Group, 1 to ACL_PBR_MAX_GROUPS
+ * @param paths Paths, all of one family; NULL if count is 0
+ * @param count Number of paths (at most ACL_PBR_MAX_PATHS), 0 deletes the group
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED,
+ *         STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t acl_pbr_set_group(uint32_t group, const acl_pbr_path_t *paths, uint32_t count);
+
+/**
+ * @brief Compile a PBR policy and make it the active one of its ID
+ *
+ * Rules are ACL rules whose action is ACL_ACTION_REDIRECT or
+ * ACL_ACTION_PERMIT; packets matching no rule are routed by the FIB. A
+ * rule may name a group that does not exist yet. PBR rules have no hit
+ * counters of their own.
+ *
+ * @param policy_id Policy, below ACL_PBR_MAX_POLICIES
+ * @param rules Rules, first match wins; NULL if count is 0
+ * @param count Number of rules (at most ACL_MAX_RULES), 0 empties the policy
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED,
+ *         STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t acl_pbr_set_policy(uint32_t policy_id, const acl_rule_t *rules, uint32_t count);
+
+/**
+ * @brief Attach a PBR policy to an ingress port, or detach it
+ *
+ * @param port Ingress port
+ * @param policy_id Policy, ACL_PBR_NONE to detach
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t acl_pbr_attach(port_id_t port, uint32_t policy_id);
+
+/**
+ * @brief Route an IP packet by the PBR policy of its ingress port
+ *
+ * Lock-free. The key is read from the header cache when it describes
+ * l3_offset, from the IP header otherwise.
+ *
+ * @param packet Packet, its ingress port in the metadata
+ * @param l3_offset Offset of the IP header
+ * @param[out] next_hop Next hop of the path chosen, unspecified for the packet's destination
+ * @param[out] egress_port Port of the path chosen
+ * @return STATUS_SUCCESS if the packet is redirected, STATUS_NOT_FOUND if
+ *         the FIB routes it, STATUS_NOT_INITIALIZED, STATUS_NO_MEMORY
+ */
+status_t acl_pbr_lookup(const packet_buffer_t *packet, uint16_t l3_offset, ip_addr_t *next_hop,
+                        port_id_t *egress_port);
+
+/**
+ * @brief Generation of the PBR configuration
+ *
+ * Bumped by every group, policy and attachment change, so decisions
+ * cached from acl_pbr_lookup() can be checked for staleness.
+ *
+ * @return Current generation
+ */
+uint32_t acl_pbr_get_generation(void);
+
+#endif /* SWITCH_SIM_ACL_H */
@@ -11,6 +11,7 @@
 
 
 #include "common/types.h"
+#include "common/table_cursor.h"
 #include "hal/packet.h"
 #include <stdint.h>
 #include <stdbool.h>
@@ -60,6 +61,11 @@ typedef struct {
     uint64_t entries_removed;        /* Number of entries removed from ARP table */    
     uint64_t entries_aged;           /* Number of entries removed due to aging */
     uint64_t current_entries;        /* Current number of entries in ARP table */  
+    uint64_t pending_queued;         /* Packets held while their next hop was resolved */
+    uint64_t pending_sent;           /* Held packets sent once their next hop resolved */
+    uint64_t pending_dropped;        /* Held packets dropped: queue full, failure or removal */
+    uint64_t requests_throttled;     /* Requests held back by the global or per-port limit */
+    uint64_t requests_coalesced;     /* Resolutions folded into a request already in flight */
 } arp_stats_t;
 
 /* ARP entry information structure - used for retrieving entries */
@@ -73,6 +79,16 @@ typedef struct {
     uint8_t state;                  /* State of the ARP entry */
 } arp_entry_info_t;
 
+/* L2 rewrite of a resolved neighbor */
+#define ARP_REWRITE_MAX_LEN 18      /* Ethernet header with one 802.1Q tag */
+
+/* Prebuilt L2 header for routed frames, immutable once published */
+typedef struct {
+    uint8_t bytes[ARP_REWRITE_MAX_LEN]; /* dst MAC, src MAC, optional 802.1Q tag, ethertype */
+    uint8_t len;                    /* 14, or 18 with a VLAN tag */
+    uint16_t port_index;            /* Egress port whose MAC is the source */
+} arp_rewrite_t;
+
 /* Forward declaration of ARP table structure */
 typedef struct arp_table_s arp_table_t;
 
@@ -160,6 +176,63 @@ status_t arp_remove_entry(arp_table_t *table, const ipv4_addr_t *ipv4);
  */
 status_t arp_handle_frame(packet_buffer_t *packet);
 
+/** Frames learned per critical section by arp_handle_frames_bulk() */
+#define ARP_BULK_MAX 64
+
+/**
+ * @brief Handle a burst of incoming ARP frames
+ *
+ * Same as arp_handle_frame() on each packet, but senders are learned in
+ * batches under one lock, and repeated frames from the same sender (such
+ * as gratuitous ARP storms) update its neighbor once per batch.
+ *
+ * @param packets Array of incoming Ethernet packets containing ARP payloads
+ * @param count Number of packets in the array
+ * @return status_t STATUS_SUCCESS if every frame was processed successfully,
+ *                  or the error code of a frame that was not
+ */
+status_t arp_handle_frames_bulk(packet_buffer_t **packets, uint32_t count);
+
+/* Static neighbor for the bulk calls below */
+typedef struct {
+    union {
+        ipv4_addr_t ipv4;
+        ipv6_addr_t ipv6;
+    } addr;                         /* Address of the table's family */
+    mac_addr_t mac;                 /* MAC address, unused on removal */
+    uint16_t port_index;            /* Port the neighbor is on, unused on removal */
+} arp_neighbor_t;
+
+/**
+ * @brief Add or update many neighbors of an ARP or ND table
+ *
+ * Neighbors are applied under one lock per ARP_BULK_MAX of them.
+ *
+ * @param table Pointer to ARP or ND table structure
+ * @param neighbors Neighbors to add
+ * @param count Number of neighbors
+ * @param stop_on_error Stop at the first neighbor that fails
+ * @param statuses Status of each neighbor, may be NULL; STATUS_NOT_EXECUTED
+ *                 for neighbors not tried
+ * @return status_t STATUS_SUCCESS, or the error of the last neighbor that failed
+ */
+status_t arp_add_neighbors_bulk(arp_table_t *table, const arp_neighbor_t *neighbors, uint32_t count,
+                                bool stop_on_error, status_t *statuses);
+
+/**
+ * @brief Remove many neighbors of an ARP or ND table under one lock
+ *
+ * @param table Pointer to ARP or ND table structure
+ * @param neighbors Neighbors to remove, by address
+ * @param count Number of neighbors
+ * @param stop_on_error Stop at the first neighbor that is not found
+ * @param statuses Status of each neighbor, may be NULL; STATUS_NOT_EXECUTED
+ *                 for neighbors not tried
+ * @return status_t STATUS_SUCCESS, or the error of the last neighbor that failed
+ */
+status_t arp_remove_neighbors_bulk(arp_table_t *table, const arp_neighbor_t *neighbors, uint32_t count,
+                                   bool stop_on_error, status_t *statuses);
+
 
 /**
  * @brief Flush all entries from the ARP table
@@ -172,6 +245,10 @@ status_t arp_flush(arp_table_t *table);
 /**
  * @brief Age the entries in the ARP table and remove expired ones
  * 
+ * Runs the entry timers that fired since the last call: reachable entries
+ * go stale, stale ones are probed or removed, and unanswered requests are
+ * retried. Call about once a second.
+ *
  * @param table Pointer to the ARP table structure
  * @return status_t Status of the operation
  */
@@ -207,6 +284,23 @@ status_t arp_set_timeout(arp_table_t *table, uint32_t timeout_seconds);
 status_t arp_get_all_entries(arp_table_t *table, arp_entry_info_t *entries, 
                             uint16_t max_entries, uint16_t *num_entries);
 
+/**
+ * @brief Get the next page of entries from the ARP table
+ *
+ * The table lock is held for one page only, so a dump of a large cache
+ * does not hold up learning and aging for its whole length.
+ *
+ * @param table Pointer to the ARP table structure
+ * @param cursor TABLE_CURSOR_START to begin; moved past the entries
+ *               returned, TABLE_CURSOR_END once the table is done
+ * @param entries Array to store the entries
+ * @param max_entries Size of the array
+ * @param num_entries Pointer to store the actual number of entries retrieved
+ * @return status_t Status of the operation
+ */
+status_t arp_get_entries_page(arp_table_t *table, table_cursor_t *cursor, arp_entry_info_t *entries,
+                              uint32_t max_entries, uint32_t *num_entries);
+
 //////**
 ///// * @brief Resolve MAC address for a given IP through ARP
 ///// *
@@ -262,6 +356,151 @@ status_t arp_get_mac_for_ip (const ipv4_addr_t *ip_addr, uint16_t port_index, ma
 
 status_t arp_resolve_async(const ipv4_addr_t *target_ip, uint16_t port_index);
 
+/**
+ * @brief Set how fast ARP requests may be sent
+ *
+ * Unanswered requests are retried with the interval doubling each time;
+ * retries count against the same limits.
+ *
+ * @param table Pointer to the ARP table structure
+ * @param global_pps Requests per second from the whole switch, 0 for no limit
+ * @param port_pps Requests per second out of each port, 0 for no limit
+ * @param burst Requests let through back to back, 0 for one second worth
+ * @return status_t Status of the operation
+ */
+status_t arp_set_request_rate(arp_table_t *table, uint32_t global_pps, uint32_t port_pps, uint32_t burst);
+
+/**
+ * @brief Get the prebuilt L2 rewrite of a resolved neighbor
+ *
+ * Lock-free for resolved neighbors; call inside rcu_read_lock() and copy the
+ * rewrite before rcu_read_unlock(). Starts resolution on port_index when the
+ * neighbor is unknown.
+ *
+ * @param ip_addr IPv4 address of the neighbor
+ * @param port_index Port to resolve on when the neighbor is unknown
+ * @param rewrite Where to store the rewrite to copy in front of the L3 header
+ * @return status_t STATUS_SUCCESS, ARP_STATUS_PENDING or another error code
+ */
+status_t arp_get_rewrite(const ipv4_addr_t *ip_addr, uint16_t port_index, const arp_rewrite_t **rewrite);
+
+/**
+ * @brief Get the neighbor generation
+ *
+ * Bumped whenever a rewrite of the ARP or ND table changes or goes away;
+ * a copied rewrite is current while the generation stays the same.
+ *
+ * @return uint32_t Current generation
+ */
+uint32_t arp_get_generation(void);
+
+/**
+ * @brief Hold a packet until its next hop is resolved
+ *
+ * The packet is copied onto the neighbor's pending queue and sent in one
+ * burst when the ARP reply arrives. Only the first packet to an unknown
+ * neighbor triggers a request.
+ *
+ * @param table Pointer to the ARP table structure
+ * @param ipv4 Pointer to the IPv4 address of the next hop
+ * @param port_index Port to resolve on if the next hop is unknown
+ * @param packet Packet with the L3 header at offset 0; the caller keeps it
+ * @return status_t ARP_STATUS_PENDING if held, ARP_STATUS_QUEUE_FULL if the
+ *         neighbor's queue is full, or another error code
+ */
+status_t arp_queue_packet(arp_table_t *table, const ipv4_addr_t *ipv4, uint16_t port_index,
+                          const packet_buffer_t *packet);
+
+/**
+ * @brief Set the VLAN a neighbor is reached through
+ *
+ * @param table Pointer to the ARP table structure
+ * @param ipv4 Pointer to the IPv4 address of the neighbor
+ * @param vlan_id VLAN tagged into the neighbor's rewrite, 0 for untagged
+ * @return status_t Status of the operation
+ */
+status_t arp_set_egress_vlan(arp_table_t *table, const ipv4_addr_t *ipv4, uint16_t vlan_id);
+
+/*
+ * IPv6 Neighbor Discovery cache. It is an arp_table_t keyed by IPv6
+ * address on the same engine: the table-wide functions above (deinit,
+ * flush, aging, statistics, timeout and request rate) apply to it as well.
+ */
+
+/**
+ * @brief Get the ND cache used for IPv6 forwarding
+ *
+ * @return arp_table_t* The ND cache
+ */
+arp_table_t *nd_table_get_instance(void);
+
+/**
+ * @brief Initialize an ND cache
+ *
+ * @param table Pointer to the table structure
+ * @return status_t Status of the operation
+ */
+status_t nd_init(arp_table_t *table);
+
+/**
+ * @brief Add or update an IPv6 neighbor
+ *
+ * @param table Pointer to the ND cache
+ * @param ipv6 Pointer to the IPv6 address
+ * @param mac Pointer to the MAC address
+ * @param port_index Port index where the MAC was learned
+ * @return status_t Status of the operation
+ */
+status_t nd_add_entry(arp_table_t *table, const ipv6_addr_t *ipv6, const mac_addr_t *mac, uint16_t port_index);
+
+/**
+ * @brief Remove an IPv6 neighbor
+ *
+ * @param table Pointer to the ND cache
+ * @param ipv6 Pointer to the IPv6 address
+ * @return status_t Status of the operation
+ */
+status_t nd_remove_entry(arp_table_t *table, const ipv6_addr_t *ipv6);
+
+/**
+ * @brief Get the prebuilt L2 rewrite of a resolved IPv6 neighbor
+ *
+ * Same rules as arp_get_rewrite(), but never starts resolution; hold the
+ * packet with nd_queue_packet() instead.
+ *
+ * @param ip_addr IPv6 address of the neighbor
+ * @param rewrite Where to store the rewrite to copy in front of the L3 header
+ * @return status_t STATUS_SUCCESS, ARP_STATUS_PENDING, ERROR_ENTRY_NOT_FOUND
+ *         or another error code
+ */
+status_t nd_get_rewrite(const ipv6_addr_t *ip_addr, const arp_rewrite_t **rewrite);
+
+/**
+ * @brief Hold a packet until its IPv6 next hop is resolved
+ *
+ * Same as arp_queue_packet(); the first packet to an unknown neighbor
+ * sends a Neighbor Solicitation.
+ *
+ * @param table Pointer to the ND cache
+ * @param ipv6 Pointer to the IPv6 address of the next hop
+ * @param port_index Port to solicit on if the next hop is unknown
+ * @param packet Packet with the L3 header at offset 0; the caller keeps it
+ * @return status_t ARP_STATUS_PENDING if held, ARP_STATUS_QUEUE_FULL if the
+ *         neighbor's queue is full, or another error code
+ */
+status_t nd_queue_packet(arp_table_t *table, const ipv6_addr_t *ipv6, uint16_t port_index,
+                         const packet_buffer_t *packet);
+
+/**
+ * @brief Learn from a received Neighbor Solicitation or Advertisement
+ *
+ * @param packet Packet received on packet->metadata.port
+ * @param l3_offset Offset of the IPv6 header in the packet
+ * @return status_t STATUS_SUCCESS if the packet was a Neighbor Discovery
+ *         message, STATUS_NOT_SUPPORTED if it was not, or another error code
+ */
+status_t nd_handle_frame(packet_buffer_t *packet, uint16_t l3_offset);
+
 
 
 #endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_ARP_H */
@@ -0,0 +1,239 @@
+/**
+ * @file bfd.h
+ * @brief Bidirectional Forwarding Detection for single-hop IPv4 neighbors
+ *
+ * Asynchronous-mode BFD (RFC 5880, RFC 5881) for thousands of sessions at
+ * intervals down to a few milliseconds. Each session owns two timers on the
+ * event loop's timer wheel, so arming and expiring them costs the same with
+ * ten sessions or ten thousand: a transmit timer re-armed with jitter after
+ * every packet, and a detection timer pushed back by every valid packet
+ * received.
+ *
+ * The control packet of a session is prebuilt, Ethernet header from the
+ * neighbor's ARP rewrite included, and is only rebuilt when the session's
+ * state, parameters or neighbor entry change. Transmit timers that expire
+ * together queue their sessions, and the packets leave in one burst per
+ * port on the next tick.
+ *
+ * When a session leaves Up, the next hop of the neighbor is marked down in
+ * the routing table at once (routing_set_nexthop_state()), so every group
+ * using it moves its flows to the remaining paths or the backup before any
+ * routing protocol has reacted, and it is marked up again when the session
+ * comes back. A neighbor that goes administratively down does not count as
+ * a failure (RFC 5882 3.2). Subscribers are told of state changes on the
+ * event loop thread, latest state first and each change once.
+ *
+ * Received packets arrive from the punt path (PUNT_CLASS_BFD). Only
+ * packets with a TTL of 255 are accepted; authentication, demand mode and
+ * echo are not supported.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_BFD_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_BFD_H
+
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "hal/packet.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Protocol constants (RFC 5880, RFC 5881) */
+#define BFD_UDP_PORT                3784    /**< Single-hop control packets */
+#define BFD_SRC_PORT_MIN            49152   /**< Source ports are taken from here up */
+#define BFD_VERSION                 1
+#define BFD_CONTROL_LEN             24      /**< Control packet without authentication */
+#define BFD_SLOW_TX_US              1000000 /**< Transmit interval floor while not Up */
+
+/* Defaults */
+#define BFD_DEFAULT_TX_US           50000   /**< Desired minimum transmit interval */
+#define BFD_DEFAULT_RX_US           50000   /**< Required minimum receive interval */
+#define BFD_DEFAULT_DETECT_MULT     3
+#define BFD_MIN_INTERVAL_US         3000    /**< Fastest interval a session accepts */
+#define BFD_MAX_SUBSCRIBERS         8
+
+/* Session states, as on the wire */
+typedef enum {
+    BFD_STATE_ADMIN_DOWN = 0,
+    BFD_STATE_DOWN = 1,
+    BFD_STATE_INIT = 2,
+    BFD_STATE_UP = 3
+} bfd_state_t;
+
+/* Diagnostic codes, as on the wire (RFC 5880 4.1) */
+typedef enum {
+    BFD_DIAG_NONE = 0,
+    BFD_DIAG_DETECT_EXPIRED = 1,    /* Control detection time expired */
+    BFD_DIAG_ECHO_FAILED = 2,
+    BFD_DIAG_NEIGHBOR_DOWN = 3,     /* Neighbor signaled session down */
+    BFD_DIAG_FORWARDING_RESET = 4,
+    BFD_DIAG_PATH_DOWN = 5,
+    BFD_DIAG_CONCAT_PATH_DOWN = 6,
+    BFD_DIAG_ADMIN_DOWN = 7
+} bfd_diag_t;
+
+/* Session parameters */
+typedef struct {
+    ipv4_addr_t peer;               /* Neighbor address, network order; the next hop it protects */
+    ipv4_addr_t local;              /* Source address of the packets, network order */
+    port_id_t port;                 /* Port facing the neighbor, the next hop's interface */
+    uint32_t desired_min_tx_us;     /* 0 for BFD_DEFAULT_TX_US */
+    uint32_t required_min_rx_us;    /* 0 for BFD_DEFAULT_RX_US */
+    uint8_t detect_mult;            /* 0 for BFD_DEFAULT_DETECT_MULT */
+} bfd_session_config_t;
+
+/* State of a session */
+typedef struct {
+    bfd_state_t state;
+    bfd_diag_t diag;                /* Why the session last left Up */
+    bfd_state_t remote_state;
+    uint32_t local_discr;
+    uint32_t remote_discr;
+    uint32_t tx_interval_us;        /* Interval in use, before jitter; 0 if not sending */
+    uint32_t detect_time_us;        /* Detection time in use, 0 before the first packet */
+    uint64_t tx_packets;
+    uint64_t rx_packets;
+    uint64_t up_transitions;
+    uint64_t down_transitions;
+} bfd_session_info_t;
+
+/* Engine counters */
+typedef struct {
+    uint32_t sessions;              /* Sessions configured */
+    uint32_t sessions_up;
+    uint64_t tx_packets;            /* Control packets sent */
+    uint64_t tx_bursts;             /* Bursts they were sent in */
+    uint64_t tx_errors;             /* Packets the port did not take */
+    uint64_t tx_unresolved;         /* Packets not sent for want of the neighbor's MAC */
+    uint64_t rx_packets;            /* Valid control packets received */
+    uint64_t rx_invalid;            /* Packets discarded by the checks of RFC 5880 6.8.6 */
+    uint64_t rx_no_session;         /* Valid packets matching no session */
+    uint64_t detect_expired;        /* Detection timeouts */
+    uint64_t state_changes;
+} bfd_stats_t;
+
+/**
+ * @brief Called on the event loop thread when a session changed state
+ *
+ * @param session_id Session, as returned by bfd_session_add()
+ * @param state New state
+ * @param diag Diagnostic of the change
+ * @param arg User argument given to bfd_subscribe()
+ */
+typedef void (*bfd_state_cb_t)(uint32_t session_id, bfd_state_t state, bfd_diag_t diag, void *arg);
+
+/**
+ * @brief Allocate the sessions and register for punted BFD packets
+ *
+ * The event loop must be initialized; the punt path should be, or no
+ * packet is ever received.
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t bfd_init(void);
+
+/**
+ * @brief Stop every session and release the engine
+ *
+ * Next hops held down by a session are released.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t bfd_shutdown(void);
+
+/**
+ * @brief Start a session to a neighbor
+ *
+ * The session starts Down and sends at the slow rate until it comes up.
+ *
+ * @param config Parameters
+ * @param[out] session_id Session, also its local discriminator
+ * @return STATUS_SUCCESS on success, STATUS_ALREADY_EXISTS if the neighbor
+ *         has a session on the port, STATUS_RESOURCE_EXHAUSTED if every
+ *         session is in use, STATUS_INVALID_PARAMETER
+ */
+status_t bfd_session_add(const bfd_session_config_t *config, uint32_t *session_id);
+
+/**
+ * @brief Stop and remove a session
+ *
+ * @param session_id Session
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t bfd_session_remove(uint32_t session_id);
+
+/**
+ * @brief Change the intervals of a session
+ *
+ * On a session that is Up, a poll sequence tells the neighbor, and an
+ * interval that gets longer only applies once it has answered.
+ *
+ * @param session_id Session
+ * @param desired_min_tx_us Desired minimum transmit interval
+ * @param required_min_rx_us Required minimum receive interval
+ * @param detect_mult Detection multiplier
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND, STATUS_INVALID_PARAMETER
+ */
+status_t bfd_session_set_intervals(uint32_t session_id, uint32_t desired_min_tx_us,
+                                   uint32_t required_min_rx_us, uint8_t detect_mult);
+
+/**
+ * @brief Take a session administratively down, or bring it back
+ *
+ * An administratively down session keeps sending, so that the neighbor
+ * knows, and leaves the next hop usable.
+ *
+ * @param session_id Session
+ * @param admin_down true to take it down
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t bfd_session_set_admin(uint32_t session_id, bool admin_down);
+
+/**
+ * @brief Get the state of a session
+ *
+ * @param session_id Session
+ * @param[out] info State
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND, STATUS_INVALID_PARAMETER
+ */
+status_t bfd_session_get_info(uint32_t session_id, bfd_session_info_t *info);
+
+/**
+ * @brief Handle received control packets
+ *
+ * The punt handler of PUNT_CLASS_BFD; the packets start at their Ethernet
+ * header and stay with the caller.
+ *
+ * @param packets Packets
+ * @param count Number of packets
+ * @param ctx Unused
+ */
+void bfd_receive_burst(packet_buffer_t **packets, uint32_t count, void *ctx);
+
+/**
+ * @brief Be told of session state changes
+ *
+ * @param cb Callback
+ * @param arg Passed to cb
+ * @return STATUS_SUCCESS on success, STATUS_RESOURCE_EXHAUSTED if the
+ *         subscriber table is full, STATUS_INVALID_PARAMETER
+ */
+status_t bfd_subscribe(bfd_state_cb_t cb, void *arg);
+
+/**
+ * @brief Stop being told of session state changes
+ *
+ * @param cb Callback given to bfd_subscribe()
+ * @param arg Argument given to bfd_subscribe()
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t bfd_unsubscribe(bfd_state_cb_t cb, void *arg);
+
+/**
+ * @brief Get engine counters
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t bfd_get_stats(bfd_stats_t *stats);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_BFD_H */
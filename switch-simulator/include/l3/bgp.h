@@ -0,0 +1,238 @@
+/**
+ * @file bgp.h
+ * @brief BGP-4 speaker for IPv4 unicast
+ *
+ * The speaker keeps a Loc-RIB of every path received from its peers or
+ * announced locally, picks the best path per prefix and installs it in
+ * the routing table through the batched RIB API. Path attributes are
+ * interned: all prefixes that arrive with the same attributes share one
+ * reference-counted attribute object, which is what keeps a full
+ * internet table affordable.
+ *
+ * Peers with the same outbound policy form an update group. Changes are
+ * queued per group and, on bgp_speaker_flush(), the prefixes sharing an
+ * attribute object are packed into as few UPDATE messages as fit; each
+ * message is formatted once and sent to every member. What a group has
+ * been sent is one bit per prefix, not a copy of the routes.
+ *
+ * The transport and the session FSM are the owner's: it passes each
+ * received message to bgp_peer_input(), reports Established and down
+ * transitions, and gets the messages to send through a callback. Peers
+ * are assumed to have negotiated four-octet AS numbers (RFC 6793).
+ *
+ * A speaker is not thread-safe; one task owns it.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_BGP_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_BGP_H
+
+#include "common/types.h"
+#include "common/error_codes.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BGP_MAX_PEERS               64
+#define BGP_MAX_UPDATE_GROUPS       16
+#define BGP_MAX_MESSAGE_LEN         4096    /**< RFC 4271 4.1 */
+#define BGP_HEADER_LEN              19
+#define BGP_DEFAULT_LOCAL_PREF      100
+
+/* BGP message types (RFC 4271 4.1) */
+#define BGP_MSG_OPEN                1
+#define BGP_MSG_UPDATE              2
+#define BGP_MSG_NOTIFICATION        3
+#define BGP_MSG_KEEPALIVE           4
+
+/* ORIGIN values */
+typedef enum {
+    BGP_ORIGIN_IGP = 0,
+    BGP_ORIGIN_EGP,
+    BGP_ORIGIN_INCOMPLETE
+} bgp_origin_t;
+
+/* Attributes of a locally announced route */
+typedef struct {
+    bgp_origin_t origin;
+    const uint32_t *as_path;        /* AS_SEQUENCE, nearest AS first; may be NULL */
+    uint16_t as_path_len;
+    uint32_t next_hop;              /* Host order, 0 for the peer-facing local address */
+    bool has_med;
+    uint32_t med;
+    bool has_local_pref;
+    uint32_t local_pref;
+    const uint32_t *communities;    /* May be NULL */
+    uint16_t community_count;
+} bgp_route_attr_t;
+
+/**
+ * @brief Sends one BGP message to a peer
+ *
+ * @param peer_id Peer, as returned by bgp_peer_add()
+ * @param msg Message, header included
+ * @param length Bytes at msg
+ * @param ctx Context from the speaker configuration
+ * @return STATUS_SUCCESS if sent
+ */
+typedef status_t (*bgp_send_cb_t)(uint32_t peer_id, const uint8_t *msg, uint16_t length, void *ctx);
+
+/* Speaker parameters */
+typedef struct {
+    uint32_t local_as;
+    uint32_t router_id;             /* BGP Identifier, host order */
+    bool install_routes;            /* Install best paths in the routing table */
+    bgp_send_cb_t send;
+    void *ctx;                      /* Passed to send */
+} bgp_speaker_config_t;
+
+/* Peer parameters */
+typedef struct {
+    uint32_t address;               /* Host order */
+    uint32_t remote_as;             /* The local AS for an iBGP peer */
+    uint32_t router_id;             /* Peer's BGP Identifier, breaks ties */
+    uint32_t local_address;         /* Our address on the session, host order */
+    uint16_t interface_index;       /* Interface the peer's routes are installed on */
+    uint32_t policy_id;             /* Outbound policy; equal policies share an update group */
+    bool next_hop_self;             /* iBGP: advertise local_address as next hop */
+} bgp_peer_config_t;
+
+/* Speaker counters */
+typedef struct {
+    uint32_t prefixes;              /* Prefixes in the Loc-RIB */
+    uint32_t paths;                 /* Paths, all peers */
+    uint32_t attrs;                 /* Distinct interned attribute objects */
+    uint32_t update_groups;
+    uint64_t updates_received;
+    uint64_t malformed_updates;
+    uint64_t updates_formatted;     /* UPDATE messages built, once per group */
+    uint64_t messages_sent;         /* Messages handed to send, once per peer */
+    uint64_t nlri_sent;
+    uint64_t withdrawn_sent;
+    uint64_t rib_changes;           /* Best-path installs and removals */
+} bgp_stats_t;
+
+/* Opaque speaker */
+typedef struct bgp_speaker bgp_speaker_t;
+
+/**
+ * @brief Create a speaker
+ *
+ * @param config Parameters, copied
+ * @return New speaker, or NULL if out of memory or config is invalid
+ */
+bgp_speaker_t *bgp_speaker_create(const bgp_speaker_config_t *config);
+
+/**
+ * @brief Free a speaker; its routes are removed from the routing table
+ *
+ * @param speaker Speaker, may be NULL
+ */
+void bgp_speaker_destroy(bgp_speaker_t *speaker);
+
+/**
+ * @brief Add a peer
+ *
+ * The peer joins the update group of its policy, creating it if needed.
+ *
+ * @param speaker Speaker
+ * @param config Peer parameters, copied
+ * @param[out] peer_id Peer identifier
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER,
+ *         STATUS_RESOURCE_EXHAUSTED if out of peers or update groups
+ */
+status_t bgp_peer_add(bgp_speaker_t *speaker, const bgp_peer_config_t *config, uint32_t *peer_id);
+
+/**
+ * @brief Remove a peer and the paths it sent
+ *
+ * @param speaker Speaker
+ * @param peer_id Peer
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t bgp_peer_remove(bgp_speaker_t *speaker, uint32_t peer_id);
+
+/**
+ * @brief Report a session transition
+ *
+ * Going Established sends the peer the whole table; going down removes
+ * the paths it sent.
+ *
+ * @param speaker Speaker
+ * @param peer_id Peer
+ * @param established New state
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t bgp_peer_set_established(bgp_speaker_t *speaker, uint32_t peer_id, bool established);
+
+/**
+ * @brief Process one message received from an Established peer
+ *
+ * UPDATEs change the Loc-RIB; KEEPALIVEs are accepted; the FSM handles OPEN
+ * and NOTIFICATION before they get here and they are ignored.
+ *
+ * @param speaker Speaker
+ * @param peer_id Peer
+ * @param msg Message, header included
+ * @param length Bytes at msg
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND, STATUS_INVALID_PARAMETER
+ *         if the message is malformed (the owner sends the NOTIFICATION),
+ *         STATUS_NO_MEMORY
+ */
+status_t bgp_peer_input(bgp_speaker_t *speaker, uint32_t peer_id, const uint8_t *msg, uint16_t length);
+
+/**
+ * @brief Announce a local route, replacing a previous local announcement
+ *
+ * @param speaker Speaker
+ * @param prefix Network address, host order
+ * @param prefix_len 0..32
+ * @param attr Attributes
+ * @param interface_index Interface the route is installed on
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t bgp_announce(bgp_speaker_t *speaker, uint32_t prefix, uint8_t prefix_len,
+                      const bgp_route_attr_t *attr, uint16_t interface_index);
+
+/**
+ * @brief Withdraw a local route
+ *
+ * @param speaker Speaker
+ * @param prefix Network address, host order
+ * @param prefix_len 0..32
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t bgp_withdraw(bgp_speaker_t *speaker, uint32_t prefix, uint8_t prefix_len);
+
+/**
+ * @brief Send the queued changes and commit the routing table batch
+ *
+ * Called after a burst of input or announcements, at most once per
+ * advertisement interval.
+ *
+ * @param speaker Speaker
+ * @return STATUS_SUCCESS on success, error of the routing table commit otherwise
+ */
+status_t bgp_speaker_flush(bgp_speaker_t *speaker);
+
+/**
+ * @brief Get the best path of a prefix
+ *
+ * @param speaker Speaker
+ * @param prefix Network address, host order
+ * @param prefix_len 0..32
+ * @param[out] next_hop Next hop, host order, may be NULL
+ * @param[out] peer_id Peer that sent the path, BGP_MAX_PEERS for a local route, may be NULL
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t bgp_lookup(const bgp_speaker_t *speaker, uint32_t prefix, uint8_t prefix_len,
+                    uint32_t *next_hop, uint32_t *peer_id);
+
+/**
+ * @brief Get speaker counters
+ *
+ * @param speaker Speaker
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t bgp_get_stats(const bgp_speaker_t *speaker, bgp_stats_t *stats);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_BGP_H */
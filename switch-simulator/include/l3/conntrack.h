@@ -0,0 +1,169 @@
+/**
+ * @file conntrack.h
+ * @brief Connection tracking and NAT for routed IPv4 traffic
+ *
+ * TCP, UDP and ICMP echo connections routed through the switch are
+ * tracked in a table per forwarding worker. Dispatch by the symmetric
+ * flow hash sends both directions of a connection to the same worker, so
+ * a worker looks up, creates, refreshes and expires its connections
+ * without locks or atomics; a table is allocated by its worker on the
+ * first packet it tracks. Packets processed off the workers share one
+ * more table under a lock.
+ *
+ * Connection tracking is a burst stage of the packet pipeline at
+ * CONNTRACK_PROCESSOR_PRIORITY, between the ACL and routing, for packets
+ * sent to the router MAC of their ingress port. It runs in passes over a
+ * burst: the keys of all packets are hashed first with their buckets
+ * prefetched, then looked up, and the connections missing are created
+ * together before each packet is accounted and translated. Connections
+ * expire on a per-table timer wheel of one-second slots, swept a bounded
+ * number of connections at a time from the stage itself; refreshing a
+ * connection only moves its deadline, not its wheel slot.
+ *
+ * NAT rules are checked in order for the first packet of a connection,
+ * the first match deciding its translation. Source NAT chooses the
+ * address and port (or ICMP echo identifier) so that replies hash to the
+ * worker holding the connection, preferring to keep the original port.
+ * Destination NAT cannot choose: when replies land on another worker, it
+ * is sent, through a lock-free queue, a copy of the connection that only
+ * translates replies and is refreshed while the connection lives.
+ * Addresses, ports and checksums are rewritten in place, the checksums
+ * updated incrementally (RFC 1624) from sums computed when the
+ * connection was created. Checksums left to the egress NIC are left alone.
+ *
+ * IP fragments, other protocols and ICMP errors pass untracked (ICMP
+ * errors are not translated); TCP state follows the flags exchanged,
+ * without window tracking. Destination NAT sees packets before routing,
+ * so only addresses the switch routes, not its own, can be translated.
+ */
+#ifndef SWITCH_SIM_CONNTRACK_H
+#define SWITCH_SIM_CONNTRACK_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../common/config.h"
+#include "../hal/packet.h"
+
+#define CONNTRACK_PROCESSOR_PRIORITY        550     /**< Pipeline priority, after the ACL and before routing */
+
+#define CONNTRACK_MAX_WORKERS               64      /**< Forwarding workers with a table of their own */
+#define CONNTRACK_MAX_NAT_RULES             64
+
+/* Idle timeouts in seconds (RFC 5382, RFC 4787, RFC 5508) */
+#define CONNTRACK_TCP_ESTABLISHED_TIMEOUT   7440
+#define CONNTRACK_TCP_TRANSITORY_TIMEOUT    240     /**< Opening or closing */
+#define CONNTRACK_TCP_CLOSED_TIMEOUT        10      /**< After a reset or both FINs */
+#define CONNTRACK_UDP_TIMEOUT               300
+#define CONNTRACK_UDP_UNREPLIED_TIMEOUT     30      /**< Until a reply is seen */
+#define CONNTRACK_ICMP_TIMEOUT              60
+
+/**
+ * @brief Translation of a NAT rule
+ */
+typedef enum {
+    CONNTRACK_NAT_SNAT = 0,         /**< Rewrite the source of connections matching */
+    CONNTRACK_NAT_DNAT              /**< Rewrite the destination of connections matching */
+} conntrack_nat_type_t;
+
+/**
+ * @brief NAT rule
+ *
+ * Addresses are in network order, ports in host order.
+ */
+typedef struct {
+    conntrack_nat_type_t type;
+    uint8_t protocol;               /**< IP_PROTO_TCP, IP_PROTO_UDP, IP_PROTO_ICMP or 0 for all */
+    ipv4_addr_t match_addr;         /**< Source prefix for SNAT, destination prefix for DNAT */
+    uint8_t match_prefix_len;       /**< 0 to 32 */
+    uint16_t match_port;            /**< DNAT only: destination port matched, 0 for any */
+    ipv4_addr_t nat_addr_min;       /**< Addresses translated to, as a range */
+    ipv4_addr_t nat_addr_max;
+    uint16_t nat_port_min;          /**< SNAT: ports taken, 0 to keep the original where it fits; */
+    uint16_t nat_port_max;          /**< DNAT: port translated to is nat_port_min, 0 to keep it */
+} conntrack_nat_rule_t;
+
+/**
+ * @brief Connection tracking counters
+ */
+typedef struct {
+    uint64_t flows;                 /**< Connections in the tables, reply copies included */
+    uint64_t created;               /**< Connections created */
+    uint64_t expired;               /**< Connections removed by their timeout */
+    uint64_t table_full;            /**< New connections dropped for want of room */
+    uint64_t snat;                  /**< Connections created with source NAT */
+    uint64_t dnat;                  /**< Connections created with destination NAT */
+    uint64_t nat_exhausted;         /**< New connections dropped for want of a free address and port */
+    uint64_t translated;            /**< Packets rewritten */
+    uint64_t untracked;             /**< Routed packets passed without tracking */
+    uint64_t mirrors_sent;          /**< Reply copies sent to another worker */
+    uint64_t mirror_drops;          /**< Reply copies lost to a full queue or table */
+} conntrack_stats_t;
+
+/**
+ * @brief Register the connection tracking stage
+ *
+ * Tracking stays off until conntrack_set_enabled().
+ *
+ * @return STATUS_SUCCESS on success, STATUS_ALREADY_INITIALIZED,
+ *         STATUS_NO_MEMORY, or the error of the stage registration
+ */
+status_t conntrack_init(void);
+
+/**
+ * @brief Unregister the stage and free the tables
+ *
+ * Must not run concurrently with packet processing.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t conntrack_cleanup(void);
+
+/**
+ * @brief Turn tracking on or off
+ *
+ * Connections are kept while it is off, and expire once it is on again.
+ *
+ * @param enabled true to track and translate routed packets
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED
+ */
+status_t conntrack_set_enabled(bool enabled);
+
+/**
+ * @brief Append a NAT rule
+ *
+ * Applies to connections created from now on.
+ *
+ * @param rule Rule, copied
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED,
+ *         STATUS_INVALID_PARAMETER, STATUS_RESOURCE_EXHAUSTED if
+ *         CONNTRACK_MAX_NAT_RULES are set, STATUS_NO_MEMORY
+ */
+status_t conntrack_add_nat_rule(const conntrack_nat_rule_t *rule);
+
+/**
+ * @brief Remove every NAT rule
+ *
+ * Connections already translated keep their translation.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_NO_MEMORY
+ */
+status_t conntrack_clear_nat_rules(void);
+
+/**
+ * @brief Remove every connection
+ *
+ * Each table is emptied by its worker on its next burst.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED
+ */
+status_t conntrack_flush(void);
+
+/**
+ * @brief Get connection tracking counters
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t conntrack_get_stats(conntrack_stats_t *stats);
+
+#endif /* SWITCH_SIM_CONNTRACK_H */
@@ -0,0 +1,124 @@
+/**
+ * @file icmp.h
+ * @brief ICMP and ICMPv6 error generation
+ *
+ * Forwarding workers report a dropped datagram with icmp_send_error().
+ * The call only checks the per-source token bucket and copies the quoted
+ * part of the datagram behind a prebuilt reply header; the message is
+ * finished, routed and sent later by the control plane through
+ * icmp_process_errors(). A traceroute storm or a forwarding loop therefore
+ * costs the workers one bucket update per dropped packet and nothing more.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_ICMP_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_ICMP_H
+
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "hal/packet.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* ICMP error types and codes (RFC 792, RFC 1191) */
+#define ICMP_TYPE_DEST_UNREACH          3
+#define ICMP_TYPE_TIME_EXCEEDED         11
+#define ICMP_CODE_NET_UNREACH           0
+#define ICMP_CODE_HOST_UNREACH          1
+#define ICMP_CODE_FRAG_NEEDED           4   /**< Parameter is the next-hop MTU */
+#define ICMP_CODE_TTL_EXCEEDED          0
+
+/* ICMPv6 error types and codes (RFC 4443) */
+#define ICMPV6_TYPE_DEST_UNREACH        1
+#define ICMPV6_TYPE_PACKET_TOO_BIG      2   /**< Parameter is the next-hop MTU */
+#define ICMPV6_TYPE_TIME_EXCEEDED       3
+#define ICMPV6_CODE_NO_ROUTE            0
+#define ICMPV6_CODE_ADDR_UNREACH        3
+#define ICMPV6_CODE_HOP_LIMIT           0
+
+/* Defaults */
+#define ICMP_RATE_DEFAULT               100     /**< Errors per second to one source */
+#define ICMP_BURST_DEFAULT              10      /**< Errors a quiet source may get back to back */
+#define ICMP_QUEUE_SIZE                 1024    /**< Errors waiting for the control plane */
+#define ICMP_DRAIN_BUDGET               64      /**< Errors sent per control-plane pass */
+#define ICMP_DRAIN_INTERVAL_US          1000    /**< Period of the control-plane pass */
+
+/* ICMP error statistics */
+typedef struct {
+    uint64_t errors_requested;       /* Drops reported by the forwarding path */
+    uint64_t errors_suppressed;      /* Not answered: ICMP error, non-first fragment, bad source... */
+    uint64_t errors_rate_limited;    /* Refused by the per-source token bucket */
+    uint64_t errors_queue_full;      /* Refused because the control-plane queue was full */
+    uint64_t errors_queued;          /* Handed to the control plane */
+    uint64_t errors_sent;            /* Messages routed and sent */
+    uint64_t errors_send_failed;     /* Messages that could not be routed or sent */
+} icmp_stats_t;
+
+/**
+ * @brief Initialize the ICMP error engine
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t icmp_init(void);
+
+/**
+ * @brief Release the ICMP error engine; queued errors are dropped
+ *
+ * @return STATUS_SUCCESS on success
+ */
+status_t icmp_shutdown(void);
+
+/**
+ * @brief Set the per-source rate limit
+ *
+ * @param rate Errors per second to one source, 0 disables error messages
+ * @param burst Errors a quiet source may get back to back (1..65535)
+ * @return STATUS_SUCCESS on success, ERROR_INVALID_PARAMETER on a bad burst
+ */
+status_t icmp_set_rate_limit(uint32_t rate, uint32_t burst);
+
+/**
+ * @brief Set the source addresses of error messages
+ *
+ * @param ipv4 Source of ICMP messages (network order), NULL to keep it
+ * @param ipv6 Source of ICMPv6 messages, NULL to keep it
+ * @return STATUS_SUCCESS on success
+ */
+status_t icmp_set_source_address(const ipv4_addr_t *ipv4, const ipv6_addr_t *ipv6);
+
+/**
+ * @brief Report a dropped datagram to its source
+ *
+ * Safe to call from any forwarding worker. Nothing is sent for datagrams
+ * that must not be answered (ICMP errors, non-first IPv4 fragments,
+ * multicast or broadcast destinations, unusable sources), and sources over
+ * their rate are refused. The packet is only read; the caller keeps it.
+ *
+ * @param packet Dropped packet
+ * @param l3_offset Offset of its IP header
+ * @param type ICMP or ICMPv6 type, matching the IP version of the packet
+ * @param code Message code
+ * @param param Next-hop MTU for Fragmentation Needed and Packet Too Big, 0 otherwise
+ * @return STATUS_SUCCESS if the error was queued,
+ *         ERROR_ICMP_RATE_LIMITED if the source is over its rate,
+ *         other error code if the error was suppressed or could not be queued
+ */
+status_t icmp_send_error(const packet_buffer_t *packet, uint16_t l3_offset,
+                         uint8_t type, uint8_t code, uint32_t param);
+
+/**
+ * @brief Finish and send queued error messages (control-plane thread only)
+ *
+ * @param budget Maximum number of messages to send
+ * @return Number of messages taken from the queue
+ */
+uint32_t icmp_process_errors(uint32_t budget);
+
+/**
+ * @brief Get ICMP error statistics
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, ERROR_INVALID_PARAMETER if stats is NULL
+ */
+status_t icmp_get_stats(icmp_stats_t *stats);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_ICMP_H */
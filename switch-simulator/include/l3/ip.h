@@ -18,6 +18,10 @@
 #define MIN_MTU     68     /**< Minimum MTU for IPv4 as per RFC 791 */
 #define MAX_MTU     9000   /**< Maximum MTU (Jumbo frames) */
 
+/** IPv4 address a.b.c.d in host byte order */
+#define MAKE_IPV4_ADDR(a, b, c, d) \
+    (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
 /**
  * @brief Macro to provide a more concise name for version_class_flow field
  * that better aligns with RFC 2460 terminology
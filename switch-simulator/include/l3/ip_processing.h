@@ -70,4 +70,23 @@ status_t ip_create_packet(const void *src_addr, const void *dst_addr, uint8_t pr
                          uint8_t ttl, const uint8_t *data, uint16_t data_len,
                          bool is_ipv6, packet_buffer_t **packet);
 
+/* Locally originated packets: routed and sent without using up a hop */
+status_t ip_output_packet(packet_buffer_t *packet);
+
+/* Per-worker exact-match cache of routed flows, retired by FIB, neighbor and MAC changes */
+status_t ip_set_flow_cache(bool enable);
+
+/* Pipeline priority of the IPv4 header check stage, ahead of the ACL */
+#define IP_VALIDATE_PROCESSOR_PRIORITY 400
+
+/* Pipeline priority of the fused IPv4 routing stage, after the ACL: routed packets
+ * (to the ingress port's MAC) get a bulk FIB lookup, their neighbor's rewrite and
+ * TTL patched in place, and leave in one TX burst per egress port */
+#define IP_ROUTE_PROCESSOR_PRIORITY 600
+
+/* Burst IPv4 header check (version, IHL, total length, checksum), vectorized where
+ * the CPU allows; bit i of the result is set if headers[i] must be dropped (count <= 64) */
+uint64_t validate_ipv4_headers_burst(const ipv4_header_t *const *headers, const uint16_t *lengths,
+                                     uint32_t count);
+
 #endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_IP_PROCESSING_H */
@@ -0,0 +1,190 @@
+/**
+ * @file mcast_fib.h
+ * @brief IPv4 multicast forwarding table with replication lists
+ *
+ * A route is an (S,G) or a (*,G) entry: the incoming interface a datagram
+ * must arrive on (the RPF check) and the list of outgoing interfaces, each
+ * an egress port, a VLAN and the L2 rewrite of the routed copy. A datagram
+ * matches its (S,G) route if there is one and the (*,G) route of its group
+ * otherwise.
+ *
+ * Replication copies no payload. The routed IP header, TTL decremented and
+ * checksum fixed, is built once per datagram; each outgoing interface then
+ * gets a small header segment with its own L2 header in front of that IP
+ * header, chained to a shared slice of the original payload. A fan-out to
+ * N interfaces costs one header build plus N segment and slice descriptors.
+ *
+ * Lookups are lock-free under RCU; the replication list of a route is an
+ * immutable object replaced whole when the route changes, so a datagram
+ * is replicated to one consistent list. State is per switch instance
+ * (switch_context.h). The control plane, PIM-SM or static configuration,
+ * programs the table; see pim.h.
+ */
+#ifndef SWITCH_SIM_MCAST_FIB_H
+#define SWITCH_SIM_MCAST_FIB_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../common/config.h"
+#include "../hal/packet.h"
+#include "../hal/port_types.h"
+
+/**
+ * @brief Source address of a (*,G) route
+ */
+#define MFIB_ANY_SOURCE             0
+
+/**
+ * @brief Outgoing interface of a route
+ */
+typedef struct {
+    port_id_t port_id;              /**< Egress port or LAG */
+    vlan_id_t vlan_id;              /**< VLAN of the interface */
+    bool tagged;                    /**< Send with an 802.1Q tag of vlan_id */
+    mac_addr_t src_mac;             /**< Router MAC of the interface */
+} mfib_oif_t;
+
+/**
+ * @brief A route and its counters
+ */
+typedef struct {
+    ipv4_addr_t source;             /**< Source, host order, MFIB_ANY_SOURCE for (*,G) */
+    ipv4_addr_t group;              /**< Group, host order */
+    port_id_t iif;                  /**< RPF port, PORT_ID_INVALID to accept any */
+    vlan_id_t iif_vlan;             /**< RPF VLAN, 0 to accept any */
+    uint64_t packets;               /**< Datagrams replicated */
+    uint64_t bytes;                 /**< Bytes of those datagrams, as received */
+    uint64_t rpf_failures;          /**< Datagrams that arrived on another interface */
+    uint32_t oif_count;             /**< Outgoing interfaces */
+    mfib_oif_t oifs[CONFIG_MFIB_MAX_OIFS]; /**< oif_count entries */
+} mfib_route_t;
+
+/**
+ * @brief Table counters
+ */
+typedef struct {
+    uint32_t routes;                /**< Routes in the table */
+    uint64_t forwarded;             /**< Datagrams replicated */
+    uint64_t copies;                /**< Copies sent */
+    uint64_t no_route;              /**< Datagrams without a route */
+    uint64_t rpf_failures;          /**< Datagrams refused by the RPF check */
+    uint64_t ttl_expired;           /**< Datagrams with a TTL of 1 or less */
+    uint64_t no_buffer;             /**< Copies lost for lack of buffers */
+} mfib_stats_t;
+
+/**
+ * @brief Sends one copy of a datagram
+ *
+ * @param port_id Egress port or LAG
+ * @param packet Copy, L2 header included; freed by mfib_forward() on return
+ * @param arg Argument given to mfib_forward()
+ * @return STATUS_SUCCESS if sent
+ */
+typedef status_t (*mfib_transmit_fn)(port_id_t port_id, packet_buffer_t *packet, void *arg);
+
+/**
+ * @brief Initialize the multicast FIB of the current switch instance
+ *
+ * @param max_routes Table capacity, 0 for CONFIG_MFIB_MAX_ROUTES
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t mfib_init(uint32_t max_routes);
+
+/**
+ * @brief Delete every route and free the table of the current instance
+ *
+ * Must not run concurrently with the forwarding calls.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t mfib_deinit(void);
+
+/**
+ * @brief Add a route or change its incoming interface
+ *
+ * The outgoing interfaces of an existing route are kept.
+ *
+ * @param source Source, host order, MFIB_ANY_SOURCE for (*,G)
+ * @param group Group, host order, a multicast address
+ * @param iif RPF port, PORT_ID_INVALID to accept any
+ * @param iif_vlan RPF VLAN, 0 to accept any
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER,
+ *         STATUS_TABLE_FULL, STATUS_NO_MEMORY
+ */
+status_t mfib_route_add(ipv4_addr_t source, ipv4_addr_t group, port_id_t iif, vlan_id_t iif_vlan);
+
+/**
+ * @brief Delete a route
+ *
+ * @param source Source, MFIB_ANY_SOURCE for (*,G)
+ * @param group Group
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t mfib_route_delete(ipv4_addr_t source, ipv4_addr_t group);
+
+/**
+ * @brief Add an outgoing interface to a route, or update its rewrite
+ *
+ * An interface is its port and VLAN.
+ *
+ * @param source Source, MFIB_ANY_SOURCE for (*,G)
+ * @param group Group
+ * @param oif Interface
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND without the route,
+ *         STATUS_RESOURCE_EXHAUSTED if the route has CONFIG_MFIB_MAX_OIFS
+ *         interfaces, STATUS_NO_MEMORY
+ */
+status_t mfib_oif_add(ipv4_addr_t source, ipv4_addr_t group, const mfib_oif_t *oif);
+
+/**
+ * @brief Remove an outgoing interface from a route
+ *
+ * @param source Source, MFIB_ANY_SOURCE for (*,G)
+ * @param group Group
+ * @param port_id Port of the interface
+ * @param vlan_id VLAN of the interface
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND, STATUS_NO_MEMORY
+ */
+status_t mfib_oif_remove(ipv4_addr_t source, ipv4_addr_t group, port_id_t port_id, vlan_id_t vlan_id);
+
+/**
+ * @brief Get a route, exactly as keyed
+ *
+ * @param source Source, MFIB_ANY_SOURCE for (*,G)
+ * @param group Group
+ * @param[out] route Route and counters
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t mfib_route_get(ipv4_addr_t source, ipv4_addr_t group, mfib_route_t *route);
+
+/**
+ * @brief Replicate a datagram to the outgoing interfaces of its route
+ *
+ * Lock-free. The IP header must be complete in the first segment; the
+ * datagram itself is not changed and stays the caller's. No copy goes back
+ * out of the interface the datagram came in on.
+ *
+ * @param packet Frame received
+ * @param l3_offset Offset of the IPv4 header
+ * @param in_port Ingress port or LAG
+ * @param in_vlan Ingress VLAN
+ * @param transmit Sends each copy
+ * @param arg Argument of transmit
+ * @param[out] copies Copies sent, may be NULL
+ * @return STATUS_SUCCESS if replicated, STATUS_NOT_FOUND without a route,
+ *         STATUS_PERMISSION_DENIED if the RPF check failed,
+ *         STATUS_INVALID_PACKET if the header is malformed or the TTL expired,
+ *         STATUS_NOT_INITIALIZED
+ */
+status_t mfib_forward(const packet_buffer_t *packet, uint16_t l3_offset, port_id_t in_port, vlan_id_t in_vlan,
+                      mfib_transmit_fn transmit, void *arg, uint32_t *copies);
+
+/**
+ * @brief Get the table counters
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t mfib_get_stats(mfib_stats_t *stats);
+
+#endif /* SWITCH_SIM_MCAST_FIB_H */
@@ -0,0 +1,153 @@
+/**
+ * @file mpls.h
+ * @brief MPLS label switching (RFC 3031, RFC 3032)
+ *
+ * The label forwarding information base (LFIB) is direct-indexed by the
+ * 20-bit incoming label: switching a frame costs one load of its top
+ * label's entry, with no hashing or prefix match. An entry says what to
+ * do with the top label (swap it for one or more labels, push labels on
+ * top of it, or pop it) and where the frame goes next: a port or LAG and
+ * the MAC address of the next hop.
+ *
+ * Label switching is a burst stage of the packet pipeline at
+ * MPLS_PROCESSOR_PRIORITY, ahead of the IP stages. The label stack was
+ * read by packet_parse() into the packet metadata; the stage resolves the
+ * entries of a burst, rewrites each frame in place and queues the burst
+ * on the TX rings of the egress ports, one ring operation per port. The
+ * new Ethernet header and label stack replace the old ones in the frame's
+ * own data: a longer stack takes headroom, a shorter one gives it back.
+ *
+ * TTL follows the uniform model for labels: swapped and pushed labels
+ * carry the incoming TTL less one, and a frame arriving with a TTL of 1
+ * or less is dropped. Popping the bottom of the stack leaves the IP TTL
+ * as it is (the short pipe model of RFC 3443). The traffic class of the
+ * top label is copied into the new labels and becomes the frame's
+ * priority for egress queueing.
+ *
+ * An entry that pops without a next hop, and the IPv4 and IPv6 explicit
+ * null labels, make the switch an egress LSR: the next label is looked up
+ * in turn, and a frame popped down to its IP payload continues through
+ * the rest of the pipeline as an IP frame. Other reserved labels are
+ * dropped, and so is multicast MPLS (ETHERTYPE_MPLS_MC), which is not
+ * switched. TTL expiry is not reported with ICMP.
+ */
+#ifndef SWITCH_SIM_MPLS_H
+#define SWITCH_SIM_MPLS_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../common/config.h"
+#include "../hal/packet.h"
+#include "../hal/port_types.h"
+
+#define MPLS_PROCESSOR_PRIORITY     350     /**< Pipeline priority of the label switching stage */
+
+#define MPLS_LABEL_IPV4_NULL        0       /**< IPv4 explicit null */
+#define MPLS_LABEL_ROUTER_ALERT     1
+#define MPLS_LABEL_IPV6_NULL        2       /**< IPv6 explicit null */
+#define MPLS_LABEL_IMPLICIT_NULL    3       /**< Never on the wire */
+#define MPLS_LABEL_RESERVED_MAX     15      /**< Labels up to this one are reserved */
+#define MPLS_LABEL_MAX              0xFFFFF
+
+#define MPLS_MAX_OUT_LABELS         3       /**< Labels an entry can swap in or push */
+
+/**
+ * @brief Operation on the top label
+ */
+typedef enum {
+    MPLS_ACTION_SWAP = 0,           /**< Replace the top label with the out labels */
+    MPLS_ACTION_PUSH,               /**< Keep the top label and push the out labels on it */
+    MPLS_ACTION_POP                 /**< Remove the top label */
+} mpls_action_t;
+
+/**
+ * @brief LFIB entry of an incoming label
+ */
+typedef struct {
+    mpls_action_t action;
+    uint32_t out_labels[MPLS_MAX_OUT_LABELS]; /**< Labels written, outermost first */
+    uint8_t out_count;              /**< 1 to MPLS_MAX_OUT_LABELS for swap and push, 0 for pop */
+    port_id_t egress_port;          /**< Port or LAG; PORT_ID_INVALID with pop to look up what is under the label */
+    mac_addr_t next_hop_mac;        /**< Destination MAC of the frames sent */
+} mpls_lfib_entry_t;
+
+/**
+ * @brief Label switching counters
+ */
+typedef struct {
+    uint64_t swapped;               /**< Frames sent with the top label swapped */
+    uint64_t pushed;                /**< Frames sent with labels pushed */
+    uint64_t popped;                /**< Frames sent with the top label popped (penultimate hop) */
+    uint64_t terminated;            /**< Frames popped to their IP payload and passed on */
+    uint64_t unknown_label;         /**< Frames whose label has no entry */
+    uint64_t reserved_label;        /**< Frames with an unsupported reserved label */
+    uint64_t bad_stack;             /**< Multicast MPLS, a truncated stack or a payload of no known type */
+    uint64_t ttl_expired;           /**< Frames with a TTL of 1 or less */
+    uint64_t tx_drops;              /**< Frames the egress port or its ring refused */
+} mpls_stats_t;
+
+/**
+ * @brief Allocate the LFIB and register the label switching stage
+ *
+ * @return STATUS_SUCCESS on success, STATUS_ALREADY_INITIALIZED,
+ *         STATUS_NO_MEMORY, or the error of the stage registration
+ */
+status_t mpls_init(void);
+
+/**
+ * @brief Unregister the stage and free the LFIB
+ *
+ * Must not run concurrently with packet processing.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t mpls_cleanup(void);
+
+/**
+ * @brief Install or replace the entry of an incoming label
+ *
+ * A replaced entry is swapped atomically: every frame sees either the old
+ * entry or the new one. The source MAC of the frames sent is the egress
+ * port's, read now.
+ *
+ * @param label Incoming label, above MPLS_LABEL_RESERVED_MAX and below CONFIG_MPLS_LABEL_SPACE
+ * @param entry Action and next hop, copied
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED,
+ *         STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t mpls_lfib_set(uint32_t label, const mpls_lfib_entry_t *entry);
+
+/**
+ * @brief Remove the entry of an incoming label
+ *
+ * @param label Incoming label
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_NOT_FOUND
+ */
+status_t mpls_lfib_delete(uint32_t label);
+
+/**
+ * @brief Get the entry of an incoming label
+ *
+ * @param label Incoming label
+ * @param[out] entry Action and next hop
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED,
+ *         STATUS_INVALID_PARAMETER, STATUS_NOT_FOUND
+ */
+status_t mpls_lfib_get(uint32_t label, mpls_lfib_entry_t *entry);
+
+/**
+ * @brief Number of labels with an entry
+ *
+ * @return Entries installed, 0 if not initialized
+ */
+uint32_t mpls_lfib_count(void);
+
+/**
+ * @brief Get the label switching counters
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t mpls_get_stats(mpls_stats_t *stats);
+
+#endif /* SWITCH_SIM_MPLS_H */
@@ -0,0 +1,172 @@
+/**
+ * @file ospf_flood.h
+ * @brief Packed Link State Update and Link State Ack transmission for OSPF
+ *
+ * An interface's transmitter packs LSAs into Link State Update packets, and
+ * LSA headers into Link State Acknowledgment packets, up to its MTU, one
+ * packet under construction per destination. A packet leaves when it is
+ * full or when its timer fires: a short pacing window for updates, the
+ * delayed-ack interval for acks, so the acks of a whole update burst share
+ * a few packets.
+ *
+ * Flooding goes out once per interface to the flood address (AllSPFRouters
+ * or AllDRouters, RFC 2328 13.3) rather than once per neighbor; unicast
+ * destinations are for retransmissions and for answering requests.
+ *
+ * A transmitter uses event loop timers and must be driven from the event
+ * loop thread.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_OSPF_FLOOD_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_OSPF_FLOOD_H
+
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/event_loop.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define OSPF_FLOOD_ALLSPFROUTERS        0xE0000005  /**< 224.0.0.5, host order */
+#define OSPF_FLOOD_ALLDROUTERS          0xE0000006  /**< 224.0.0.6, host order */
+#define OSPF_FLOOD_HEADER_LEN           24          /**< OSPF packet header */
+#define OSPF_FLOOD_LSA_HEADER_LEN       20
+#define OSPF_FLOOD_IP_OVERHEAD          20          /**< IPv4 header without options */
+#define OSPF_FLOOD_MAX_DESTINATIONS     34          /**< Neighbors of an interface plus the two groups */
+#define OSPF_FLOOD_DEFAULT_PACING_MS    33          /**< Update coalescing window */
+#define OSPF_FLOOD_DEFAULT_ACK_DELAY_MS 1000        /**< Below RxmtInterval (RFC 2328 13.5) */
+
+/**
+ * @brief Sends one finished OSPF packet
+ *
+ * @param dst Destination address, host order
+ * @param packet OSPF packet, header included, checksum filled in
+ * @param length Bytes at packet
+ * @param ctx Context from the configuration
+ * @return STATUS_SUCCESS if sent
+ */
+typedef status_t (*ospf_flood_send_cb_t)(uint32_t dst, const uint8_t *packet, uint16_t length, void *ctx);
+
+/* Interface parameters */
+typedef struct {
+    uint32_t router_id;             /* Host order */
+    uint32_t area_id;               /* Host order */
+    uint16_t mtu;                   /* IP MTU of the interface */
+    uint16_t transmit_delay;        /* InfTransDelay added to LS age, seconds */
+    uint32_t pacing_ms;             /* Update coalescing window, 0 to send at once */
+    uint32_t ack_delay_ms;          /* Delayed-ack interval */
+    ospf_flood_send_cb_t send;
+    void *ctx;                      /* Passed to send */
+} ospf_flood_config_t;
+
+/* Transmitter counters */
+typedef struct {
+    uint64_t lsu_packets;           /* Link State Update packets sent */
+    uint64_t lsas;                  /* LSAs sent in them */
+    uint64_t ack_packets;           /* Link State Ack packets sent */
+    uint64_t acks;                  /* LSA headers acknowledged in them */
+    uint64_t coalesced;             /* Queued LSAs or acks that replaced a pending copy */
+    uint64_t send_errors;
+} ospf_flood_stats_t;
+
+/* Packet under construction for one destination; private */
+typedef struct {
+    uint32_t dst;
+    uint8_t *buf;                   /* OSPF header, then the body */
+    uint16_t len;                   /* 0 while empty */
+    uint32_t count;                 /* LSAs or LSA headers in the body */
+} ospf_flood_pending_t;
+
+/* Transmitter of one interface, embedded by its owner; fields are private */
+typedef struct {
+    ospf_flood_config_t config;
+    uint32_t flood_addr;
+    uint16_t max_len;               /* Largest OSPF packet that fits the MTU */
+    ospf_flood_pending_t lsu[OSPF_FLOOD_MAX_DESTINATIONS];
+    ospf_flood_pending_t ack[OSPF_FLOOD_MAX_DESTINATIONS];
+    event_timer_t lsu_timer;
+    event_timer_t ack_timer;
+    ospf_flood_stats_t stats;
+} ospf_flood_tx_t;
+
+/**
+ * @brief Prepare the transmitter of an interface
+ *
+ * Floods go to AllSPFRouters until ospf_flood_set_flood_address() says otherwise.
+ *
+ * @param tx Transmitter
+ * @param config Parameters, copied
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER if the MTU
+ *         cannot hold one LSA header or send is missing
+ */
+status_t ospf_flood_init(ospf_flood_tx_t *tx, const ospf_flood_config_t *config);
+
+/**
+ * @brief Send everything pending and release the transmitter
+ *
+ * @param tx Transmitter
+ */
+void ospf_flood_destroy(ospf_flood_tx_t *tx);
+
+/**
+ * @brief Set where floods go, as the interface state changes
+ *
+ * @param tx Transmitter
+ * @param addr OSPF_FLOOD_ALLSPFROUTERS on DR, BDR and point-to-point
+ *             interfaces, OSPF_FLOOD_ALLDROUTERS on the others
+ */
+void ospf_flood_set_flood_address(ospf_flood_tx_t *tx, uint32_t addr);
+
+/**
+ * @brief Flood an LSA on the interface, once for all its neighbors
+ *
+ * @param tx Transmitter
+ * @param lsa LSA, header included, network order
+ * @param length Bytes at lsa
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t ospf_flood_lsa(ospf_flood_tx_t *tx, const void *lsa, uint16_t length);
+
+/**
+ * @brief Send an LSA to one neighbor
+ *
+ * @param tx Transmitter
+ * @param dst Neighbor address, host order
+ * @param lsa LSA, header included, network order
+ * @param length Bytes at lsa
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY,
+ *         STATUS_RESOURCE_EXHAUSTED if too many destinations are pending
+ */
+status_t ospf_flood_send_lsa(ospf_flood_tx_t *tx, uint32_t dst, const void *lsa, uint16_t length);
+
+/**
+ * @brief Acknowledge an LSA
+ *
+ * Delayed acks go to the flood address when the ack timer fires; direct
+ * acks go to dst within the pacing window.
+ *
+ * @param tx Transmitter
+ * @param dst Neighbor address for a direct ack, host order; ignored if delayed
+ * @param lsa_header Header of the LSA, network order
+ * @param delayed true for a delayed ack (RFC 2328 13.5)
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY,
+ *         STATUS_RESOURCE_EXHAUSTED if too many destinations are pending
+ */
+status_t ospf_flood_ack(ospf_flood_tx_t *tx, uint32_t dst, const void *lsa_header, bool delayed);
+
+/**
+ * @brief Send every pending packet now
+ *
+ * @param tx Transmitter
+ */
+void ospf_flood_flush(ospf_flood_tx_t *tx);
+
+/**
+ * @brief Get transmitter counters
+ *
+ * @param tx Transmitter
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t ospf_flood_get_stats(const ospf_flood_tx_t *tx, ospf_flood_stats_t *stats);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_OSPF_FLOOD_H */
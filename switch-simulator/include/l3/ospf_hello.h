@@ -0,0 +1,222 @@
+/**
+ * @file ospf_hello.h
+ * @brief OSPF Hello transmission and neighbor inactivity timers
+ *
+ * Every interface has its own Hello timer and every neighbor its own
+ * inactivity timer, all on the event loop wheel, so no tick walks every
+ * interface or every neighbor. Hello timers start at a random phase and
+ * fire a jittered interval apart, which keeps hundreds of interfaces from
+ * sending in the same tick.
+ *
+ * The Hello packet of an interface is built once into a template, checksum
+ * included, and only rebuilt when something it carries changes: the DR,
+ * the BDR, the priority or the set of neighbors. A Hello received only
+ * records its arrival time; the inactivity timer checks it when it fires
+ * and re-arms for what is left of RouterDeadInterval (RFC 2328 10.5).
+ *
+ * An interface uses event loop timers and must be driven from the event
+ * loop thread.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_OSPF_HELLO_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_OSPF_HELLO_H
+
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/event_loop.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define OSPF_HELLO_MAX_NEIGHBORS        32          /**< Neighbors listed in one Hello */
+#define OSPF_HELLO_HEADER_LEN           24          /**< OSPF packet header */
+#define OSPF_HELLO_BODY_LEN             20          /**< Hello fields before the neighbor list */
+#define OSPF_HELLO_MAX_LEN              (OSPF_HELLO_HEADER_LEN + OSPF_HELLO_BODY_LEN + \
+                                         4 * OSPF_HELLO_MAX_NEIGHBORS)
+#define OSPF_HELLO_ALLSPFROUTERS        0xE0000005  /**< 224.0.0.5, host order */
+#define OSPF_HELLO_DEFAULT_JITTER_PCT   10          /**< Hellos leave 90 to 100 percent of the interval apart */
+
+/**
+ * @brief Sends one Hello
+ *
+ * @param dst Destination address, host order
+ * @param packet OSPF packet, header included, checksum filled in
+ * @param length Bytes at packet
+ * @param ctx Context from the configuration
+ * @return STATUS_SUCCESS if sent
+ */
+typedef status_t (*ospf_hello_send_cb_t)(uint32_t dst, const uint8_t *packet, uint16_t length, void *ctx);
+
+/**
+ * @brief Reports a neighbor whose RouterDeadInterval ran out
+ *
+ * The neighbor is already gone from the interface when this runs.
+ *
+ * @param router_id Router ID of the neighbor, host order
+ * @param neighbor_ip Address of the neighbor, host order
+ * @param ctx Context from the configuration
+ */
+typedef void (*ospf_hello_dead_cb_t)(uint32_t router_id, uint32_t neighbor_ip, void *ctx);
+
+/* Interface parameters */
+typedef struct {
+    uint32_t router_id;             /* Host order */
+    uint32_t area_id;               /* Host order */
+    uint32_t network_mask;          /* Host order */
+    uint32_t dst;                   /* Where Hellos go, AllSPFRouters if 0 */
+    uint16_t hello_interval;        /* HelloInterval, seconds */
+    uint32_t dead_interval;         /* RouterDeadInterval, seconds */
+    uint8_t  options;
+    uint8_t  priority;
+    uint8_t  jitter_pct;            /* Up to this much earlier than the interval, at most 50 */
+    ospf_hello_send_cb_t send;
+    ospf_hello_dead_cb_t dead;      /* May be NULL */
+    void *ctx;                      /* Passed to send and dead */
+} ospf_hello_config_t;
+
+/* Interface counters */
+typedef struct {
+    uint64_t hellos_sent;
+    uint64_t send_errors;
+    uint64_t template_builds;       /* Times the Hello packet was rebuilt */
+    uint64_t hellos_received;       /* Refreshes of a known neighbor */
+    uint64_t inactivity_rearms;     /* Inactivity timers that found a newer Hello */
+    uint64_t neighbors_dead;        /* Neighbors dropped by RouterDeadInterval */
+} ospf_hello_stats_t;
+
+struct ospf_hello_iface;
+
+/* Neighbor as the Hello protocol sees it; fields are private */
+typedef struct {
+    uint32_t router_id;
+    uint32_t neighbor_ip;
+    uint64_t last_hello_us;         /* Event loop clock */
+    event_timer_t inactivity_timer;
+    struct ospf_hello_iface *iface;
+    bool in_use;
+} ospf_hello_neighbor_t;
+
+/* Hello state of one interface, embedded by its owner; fields are private */
+typedef struct ospf_hello_iface {
+    ospf_hello_config_t config;
+    uint32_t dr;                    /* Host order */
+    uint32_t bdr;                   /* Host order */
+    ospf_hello_neighbor_t neighbors[OSPF_HELLO_MAX_NEIGHBORS];
+    uint16_t neighbor_count;
+    uint8_t template[OSPF_HELLO_MAX_LEN];
+    uint16_t template_len;
+    bool template_stale;
+    bool running;
+    uint32_t jitter_state;          /* xorshift32 */
+    event_timer_t hello_timer;
+    ospf_hello_stats_t stats;
+} ospf_hello_iface_t;
+
+/**
+ * @brief Prepare the Hello state of an interface
+ *
+ * @param iface Interface
+ * @param config Parameters, copied
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER if send is
+ *         missing, an interval is zero, or the dead interval is not
+ *         longer than the Hello interval
+ */
+status_t ospf_hello_init(ospf_hello_iface_t *iface, const ospf_hello_config_t *config);
+
+/**
+ * @brief Stop the timers and forget every neighbor
+ *
+ * @param iface Interface
+ */
+void ospf_hello_destroy(ospf_hello_iface_t *iface);
+
+/**
+ * @brief Start sending Hellos
+ *
+ * The first Hello leaves within the jitter window, the next ones one
+ * jittered interval apart.
+ *
+ * @param iface Interface
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, or the error
+ *         of event_timer_start()
+ */
+status_t ospf_hello_start(ospf_hello_iface_t *iface);
+
+/**
+ * @brief Stop sending Hellos; neighbors keep their inactivity timers
+ *
+ * @param iface Interface
+ */
+void ospf_hello_stop(ospf_hello_iface_t *iface);
+
+/**
+ * @brief Send a Hello now, for instance after a DR election
+ *
+ * The periodic timer is not moved.
+ *
+ * @param iface Interface
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, or the error of send
+ */
+status_t ospf_hello_send_now(ospf_hello_iface_t *iface);
+
+/**
+ * @brief Set the DR and BDR the Hellos announce
+ *
+ * @param iface Interface
+ * @param dr Designated Router address, host order
+ * @param bdr Backup Designated Router address, host order
+ */
+void ospf_hello_set_dr(ospf_hello_iface_t *iface, uint32_t dr, uint32_t bdr);
+
+/**
+ * @brief Set the Router Priority the Hellos announce
+ *
+ * @param iface Interface
+ * @param priority Router Priority
+ */
+void ospf_hello_set_priority(ospf_hello_iface_t *iface, uint8_t priority);
+
+/**
+ * @brief Record a Hello from a neighbor, adding the neighbor if it is new
+ *
+ * @param iface Interface
+ * @param router_id Router ID of the neighbor, host order
+ * @param neighbor_ip Source address of the Hello, host order
+ * @param[out] neighbor The neighbor, for ospf_hello_neighbor_refresh() until it is
+ *             removed or reported dead; may be NULL
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER,
+ *         STATUS_RESOURCE_EXHAUSTED if the interface has no room for a new neighbor
+ */
+status_t ospf_hello_received(ospf_hello_iface_t *iface, uint32_t router_id, uint32_t neighbor_ip,
+                             ospf_hello_neighbor_t **neighbor);
+
+/**
+ * @brief Record a Hello from a neighbor already looked up
+ *
+ * Only the arrival time is stored; the inactivity timer is not touched.
+ *
+ * @param neighbor Neighbor from ospf_hello_received()
+ */
+static inline void ospf_hello_neighbor_refresh(ospf_hello_neighbor_t *neighbor) {
+    neighbor->last_hello_us = event_loop_now_us();
+    neighbor->iface->stats.hellos_received++;
+}
+
+/**
+ * @brief Drop a neighbor, for instance when its adjacency is torn down
+ *
+ * @param iface Interface
+ * @param router_id Router ID of the neighbor, host order
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NOT_FOUND
+ */
+status_t ospf_hello_remove_neighbor(ospf_hello_iface_t *iface, uint32_t router_id);
+
+/**
+ * @brief Get interface counters
+ *
+ * @param iface Interface
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t ospf_hello_get_stats(const ospf_hello_iface_t *iface, ospf_hello_stats_t *stats);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_OSPF_HELLO_H */
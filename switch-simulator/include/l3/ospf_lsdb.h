@@ -0,0 +1,169 @@
+/**
+ * @file ospf_lsdb.h
+ * @brief Hashed OSPF link state database with aging buckets
+ *
+ * The LSDB of an area keeps its LSAs in a hash table keyed by the LSA
+ * triple (LS type, Link State ID, Advertising Router), so installing or
+ * finding one LSA of a Link State Update costs the same however large the
+ * database is. Every LSA also sits in one bucket of a one-second timing
+ * wheel, at the second of its next aging deadline: LSRefreshTime for the
+ * LSAs this router originated, MaxAge for the others. ospf_lsdb_age()
+ * only visits the buckets of the seconds that passed.
+ *
+ * A database is not thread-safe; the OSPF task owns it.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_OSPF_LSDB_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_OSPF_LSDB_H
+
+#include "common/types.h"
+#include "common/error_codes.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define OSPF_LSDB_MAX_AGE           3600    /**< MaxAge, seconds (RFC 2328 B) */
+#define OSPF_LSDB_REFRESH_TIME      1800    /**< LSRefreshTime, seconds */
+
+/* Aging deadlines reported by ospf_lsdb_age() */
+typedef enum {
+    OSPF_LSDB_EVENT_REFRESH = 0,    /* A self-originated LSA is due for reorigination */
+    OSPF_LSDB_EVENT_MAX_AGE         /* An LSA reached MaxAge and must be flushed */
+} ospf_lsdb_event_t;
+
+/* One installed LSA */
+typedef struct ospf_lsdb_entry {
+    uint8_t ls_type;
+    uint32_t ls_id;
+    uint32_t adv_router;
+    uint32_t seq;                   /* LS sequence number */
+    uint16_t checksum;              /* LS checksum */
+    uint16_t length;                /* Bytes at data */
+    uint8_t *data;                  /* The whole LSA, header included, as received */
+    uint16_t install_age;           /* LS age when installed */
+    uint32_t install_time;          /* Time of installation, seconds */
+    /* Private to the database */
+    struct ospf_lsdb_entry *hash_next;
+    struct ospf_lsdb_entry *wheel_prev;
+    struct ospf_lsdb_entry *wheel_next;
+    uint32_t deadline;              /* Second of the next aging event */
+    uint8_t wheel_state;
+} ospf_lsdb_entry_t;
+
+/* Opaque database of one area */
+typedef struct ospf_lsdb ospf_lsdb_t;
+
+/**
+ * @brief Called for every aging deadline that passed
+ *
+ * The callback may install, reinstall or remove any LSA, this one
+ * included. A refreshed LSA that is not reinstalled is kept until MaxAge;
+ * an LSA at MaxAge stays in the database until it is removed.
+ *
+ * @param db Database
+ * @param entry LSA that reached the deadline
+ * @param event Which deadline
+ * @param ctx Context given to ospf_lsdb_age()
+ */
+typedef void (*ospf_lsdb_age_cb_t)(ospf_lsdb_t *db, const ospf_lsdb_entry_t *entry,
+                                   ospf_lsdb_event_t event, void *ctx);
+
+/**
+ * @brief Called for every LSA by ospf_lsdb_foreach()
+ *
+ * @return false to stop the walk
+ */
+typedef bool (*ospf_lsdb_walk_cb_t)(const ospf_lsdb_entry_t *entry, void *ctx);
+
+/**
+ * @brief Create an empty database
+ *
+ * @param router_id Router ID of this router; its LSAs are refreshed
+ * @param now Current time, seconds
+ * @return New database, or NULL if out of memory
+ */
+ospf_lsdb_t *ospf_lsdb_create(uint32_t router_id, uint32_t now);
+
+/**
+ * @brief Free a database and its LSAs
+ *
+ * @param db Database, may be NULL
+ */
+void ospf_lsdb_destroy(ospf_lsdb_t *db);
+
+/**
+ * @brief Install an LSA, replacing the instance with the same triple
+ *
+ * The LSA is copied. Type, Link State ID, Advertising Router, sequence
+ * number, checksum and age are read from its header.
+ *
+ * @param db Database
+ * @param lsa LSA, header included
+ * @param length Bytes at lsa, at least the 20-byte header
+ * @param now Current time, seconds
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t ospf_lsdb_install(ospf_lsdb_t *db, const void *lsa, uint16_t length, uint32_t now);
+
+/**
+ * @brief Find an LSA by its triple
+ *
+ * @param db Database
+ * @param ls_type LS type
+ * @param ls_id Link State ID, host order
+ * @param adv_router Advertising Router, host order
+ * @return The LSA, NULL if not installed; valid until it is removed
+ */
+const ospf_lsdb_entry_t *ospf_lsdb_lookup(const ospf_lsdb_t *db, uint8_t ls_type,
+                                          uint32_t ls_id, uint32_t adv_router);
+
+/**
+ * @brief Remove an LSA
+ *
+ * @param db Database
+ * @param ls_type LS type
+ * @param ls_id Link State ID, host order
+ * @param adv_router Advertising Router, host order
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if not installed
+ */
+status_t ospf_lsdb_remove(ospf_lsdb_t *db, uint8_t ls_type, uint32_t ls_id, uint32_t adv_router);
+
+/**
+ * @brief Current LS age of an LSA
+ *
+ * @param entry LSA
+ * @param now Current time, seconds
+ * @return Age in seconds, at most OSPF_LSDB_MAX_AGE
+ */
+uint16_t ospf_lsdb_entry_age(const ospf_lsdb_entry_t *entry, uint32_t now);
+
+/**
+ * @brief Report the aging deadlines passed since the last call
+ *
+ * @param db Database
+ * @param now Current time, seconds
+ * @param cb Called for each deadline, may be NULL
+ * @param ctx Passed to cb
+ * @return Number of deadlines reported
+ */
+uint32_t ospf_lsdb_age(ospf_lsdb_t *db, uint32_t now, ospf_lsdb_age_cb_t cb, void *ctx);
+
+/**
+ * @brief Visit every LSA, in no particular order
+ *
+ * The callback must not change the database.
+ *
+ * @param db Database
+ * @param cb Called for each LSA
+ * @param ctx Passed to cb
+ */
+void ospf_lsdb_foreach(const ospf_lsdb_t *db, ospf_lsdb_walk_cb_t cb, void *ctx);
+
+/**
+ * @brief Number of LSAs installed
+ *
+ * @param db Database
+ * @return LSA count
+ */
+uint32_t ospf_lsdb_count(const ospf_lsdb_t *db);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_OSPF_LSDB_H */
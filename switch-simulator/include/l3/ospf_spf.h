@@ -0,0 +1,187 @@
+/**
+ * @file ospf_spf.h
+ * @brief Shortest path first engine for OSPF areas
+ *
+ * The engine keeps the area topology as an adjacency-list graph of router
+ * and network vertices, fed from the LSDB one LSA at a time: the transit
+ * links of a router-LSA or network-LSA with ospf_spf_set_links(), the stub
+ * networks and summarized prefixes it reaches with ospf_spf_set_prefixes().
+ * ospf_spf_run() computes the shortest path tree with a binary-heap
+ * Dijkstra and reports every prefix whose route changed.
+ *
+ * Runs are incremental where the change allows it. A prefix-only change
+ * (a stub link, or a leaf router that only carries stubs) is a partial
+ * route calculation over the prefixes it touches. A transit link change
+ * that no shortest path uses or could use leaves the tree as it is; only
+ * changes that can move the tree rerun Dijkstra.
+ *
+ * Each route also carries a precomputed loop-free alternate (RFC 5286):
+ * the neighbor with the cheapest path to the prefix among those whose
+ * shortest path there does not come back through this router. It is
+ * meant to be the backup of the route's next-hop group, which forwarding
+ * switches to as soon as the primary links fail, while the area
+ * reconverges. The distances from every neighbor are recomputed after any
+ * transit link change, tight or not; remote LFA is not computed.
+ *
+ * An engine is not thread-safe; the OSPF task owns it.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_OSPF_SPF_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_OSPF_SPF_H
+
+#include "common/types.h"
+#include "common/error_codes.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define OSPF_SPF_MAX_PATHS      4               /**< Equal-cost next hops kept per route */
+#define OSPF_SPF_INFINITY       0xFFFFFFFFu     /**< Distance of an unreachable vertex */
+
+/* Vertex types, as the LSA that describes them */
+typedef enum {
+    OSPF_SPF_VERTEX_ROUTER = 0,     /* Router-LSA; the ID is the router ID */
+    OSPF_SPF_VERTEX_NETWORK         /* Network-LSA; the ID is the DR interface address */
+} ospf_spf_vertex_type_t;
+
+/* Transit link from one vertex to another */
+typedef struct {
+    ospf_spf_vertex_type_t type;    /* Type of the far end */
+    uint32_t id;                    /* ID of the far end */
+    uint32_t metric;                /* Link cost, 0 from a network to its routers */
+} ospf_spf_link_t;
+
+/* Prefix reached through a vertex */
+typedef struct {
+    uint32_t addr;                  /* Network address, host order */
+    uint8_t prefix_len;             /* 0..32 */
+    uint32_t metric;                /* Cost from the vertex */
+} ospf_spf_prefix_t;
+
+/* Route to a prefix as computed by the last run */
+typedef struct {
+    uint32_t addr;                  /* Network address, host order */
+    uint8_t prefix_len;
+    uint32_t cost;                  /* Total cost, OSPF_SPF_INFINITY if withdrawn */
+    uint8_t nexthop_count;
+    uint32_t nexthops[OSPF_SPF_MAX_PATHS]; /* First-hop router IDs, 0 for directly attached */
+    uint32_t backup;                /* Router ID of the loop-free alternate, 0 if none */
+} ospf_spf_route_t;
+
+/* Engine counters */
+typedef struct {
+    uint64_t full_runs;             /* Runs that recomputed the shortest path tree */
+    uint64_t partial_runs;          /* Runs that only recomputed some prefixes */
+    uint64_t routes_changed;        /* Route changes reported */
+    uint64_t last_run_us;           /* Duration of the last run */
+    uint64_t lfa_runs;              /* Runs that recomputed the distances from the neighbors */
+    uint32_t protected_prefixes;    /* Reachable prefixes with a loop-free alternate */
+    uint32_t vertices;              /* Vertices known, reachable or not */
+    uint32_t prefixes;              /* Prefixes known */
+} ospf_spf_stats_t;
+
+/* Opaque engine of one area */
+typedef struct ospf_spf ospf_spf_t;
+
+/**
+ * @brief Called for every route that changed during a run
+ *
+ * @param route New route; cost is OSPF_SPF_INFINITY for a withdrawn prefix
+ * @param ctx Context given to ospf_spf_run()
+ */
+typedef void (*ospf_spf_route_cb_t)(const ospf_spf_route_t *route, void *ctx);
+
+/**
+ * @brief Create the engine of an area
+ *
+ * @param root_id Router ID of this router, the root of the tree
+ * @return New engine, or NULL if out of memory
+ */
+ospf_spf_t *ospf_spf_create(uint32_t root_id);
+
+/**
+ * @brief Free an engine
+ *
+ * @param spf Engine, may be NULL
+ */
+void ospf_spf_destroy(ospf_spf_t *spf);
+
+/**
+ * @brief Replace the transit links of a vertex
+ *
+ * A link is only used when the far end links back (RFC 2328 16.1).
+ *
+ * @param spf Engine
+ * @param type Vertex type
+ * @param id Vertex ID
+ * @param links Links, NULL if count is 0
+ * @param count Number of links
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t ospf_spf_set_links(ospf_spf_t *spf, ospf_spf_vertex_type_t type, uint32_t id,
+                            const ospf_spf_link_t *links, uint32_t count);
+
+/**
+ * @brief Replace the prefixes reached through a vertex
+ *
+ * @param spf Engine
+ * @param type Vertex type
+ * @param id Vertex ID
+ * @param prefixes Prefixes, NULL if count is 0
+ * @param count Number of prefixes
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t ospf_spf_set_prefixes(ospf_spf_t *spf, ospf_spf_vertex_type_t type, uint32_t id,
+                               const ospf_spf_prefix_t *prefixes, uint32_t count);
+
+/**
+ * @brief Remove a vertex, as when its LSA is flushed
+ *
+ * @param spf Engine
+ * @param type Vertex type
+ * @param id Vertex ID
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if the vertex is unknown
+ */
+status_t ospf_spf_remove_vertex(ospf_spf_t *spf, ospf_spf_vertex_type_t type, uint32_t id);
+
+/**
+ * @brief Bring the routes up to date with the topology
+ *
+ * @param spf Engine
+ * @param cb Called for each route that changed, may be NULL
+ * @param ctx Passed to cb
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t ospf_spf_run(ospf_spf_t *spf, ospf_spf_route_cb_t cb, void *ctx);
+
+/**
+ * @brief Get the distance of a vertex from the root after the last run
+ *
+ * @param spf Engine
+ * @param type Vertex type
+ * @param id Vertex ID
+ * @return Distance, OSPF_SPF_INFINITY if unknown or unreachable
+ */
+uint32_t ospf_spf_get_distance(const ospf_spf_t *spf, ospf_spf_vertex_type_t type, uint32_t id);
+
+/**
+ * @brief Get the current route to a prefix
+ *
+ * @param spf Engine
+ * @param addr Network address, host order
+ * @param prefix_len Prefix length
+ * @param[out] route Route
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if the prefix is unreachable
+ */
+status_t ospf_spf_get_route(const ospf_spf_t *spf, uint32_t addr, uint8_t prefix_len,
+                            ospf_spf_route_t *route);
+
+/**
+ * @brief Get engine counters
+ *
+ * @param spf Engine
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t ospf_spf_get_stats(const ospf_spf_t *spf, ospf_spf_stats_t *stats);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_OSPF_SPF_H */
@@ -0,0 +1,167 @@
+/**
+ * @file ospf_throttle.h
+ * @brief SPF back-off and LSA origination throttling for OSPF
+ *
+ * SPF runs are scheduled by the RFC 8405 back-off state machine. The
+ * first event after a quiet period runs SPF after a short initial delay;
+ * events within TIME_TO_LEARN of it are treated as one incident and use
+ * the short delay; once TIME_TO_LEARN has passed the network is assumed
+ * to be flapping and the long delay applies, until no event has been
+ * seen for HOLDDOWN and the machine is quiet again.
+ *
+ * LSA origination is throttled per LSA with an exponential hold: the
+ * first origination after a quiet period waits the start delay, the next
+ * the hold time, each later one twice the previous interval up to the
+ * maximum. Requests made while an origination is pending are coalesced.
+ *
+ * Both use timers of the event loop and must be driven from the event
+ * loop thread, like the callbacks they run.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_OSPF_THROTTLE_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_OSPF_THROTTLE_H
+
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/event_loop.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defaults, milliseconds; the SPF values are those suggested by RFC 8405 */
+#define OSPF_THROTTLE_SPF_INITIAL_DELAY_MS  50
+#define OSPF_THROTTLE_SPF_SHORT_DELAY_MS    200
+#define OSPF_THROTTLE_SPF_LONG_DELAY_MS     5000
+#define OSPF_THROTTLE_SPF_TIME_TO_LEARN_MS  500
+#define OSPF_THROTTLE_SPF_HOLDDOWN_MS       10000
+#define OSPF_THROTTLE_LSA_START_MS          0
+#define OSPF_THROTTLE_LSA_HOLD_MS           5000    /* MinLSInterval (RFC 2328 B) */
+#define OSPF_THROTTLE_LSA_MAX_WAIT_MS       5000
+
+/* Timing of both throttles, milliseconds */
+typedef struct {
+    uint32_t spf_initial_delay_ms;  /* First SPF after a quiet period */
+    uint32_t spf_short_delay_ms;    /* SPF while learning an incident */
+    uint32_t spf_long_delay_ms;     /* SPF during a flap storm */
+    uint32_t spf_time_to_learn_ms;  /* How long an incident may last */
+    uint32_t spf_holddown_ms;       /* Quiet time needed to go back to the initial delay */
+    uint32_t lsa_start_ms;          /* First origination after a quiet period */
+    uint32_t lsa_hold_ms;           /* Interval before the second origination */
+    uint32_t lsa_max_wait_ms;       /* Longest interval between originations */
+} ospf_throttle_config_t;
+
+/* SPF back-off states (RFC 8405 5.1) */
+typedef enum {
+    OSPF_SPF_BACKOFF_QUIET = 0,
+    OSPF_SPF_BACKOFF_SHORT_WAIT,
+    OSPF_SPF_BACKOFF_LONG_WAIT
+} ospf_spf_backoff_state_t;
+
+/**
+ * @brief Called when a throttled action is due
+ *
+ * @param arg User argument given at initialization
+ */
+typedef void (*ospf_throttle_cb_t)(void *arg);
+
+/* SPF scheduler of one area, embedded by its owner; fields are private */
+typedef struct {
+    const ospf_throttle_config_t *config;
+    ospf_spf_backoff_state_t state;
+    event_timer_t spf_timer;
+    event_timer_t learn_timer;
+    event_timer_t holddown_timer;
+    ospf_throttle_cb_t run_spf;
+    void *arg;
+    uint64_t events;                /* IGP events reported */
+    uint64_t runs;                  /* SPF runs started */
+} ospf_spf_backoff_t;
+
+/* Origination throttle of one LSA, embedded by its owner; fields are private */
+typedef struct {
+    const ospf_throttle_config_t *config;
+    event_timer_t timer;
+    uint64_t last_us;               /* Last origination, 0 if none yet */
+    uint32_t interval_ms;           /* Minimum time from the last origination to the next */
+    ospf_throttle_cb_t originate;
+    void *arg;
+} ospf_lsa_throttle_t;
+
+/**
+ * @brief Get the default timing
+ *
+ * @param[out] config Timing
+ */
+void ospf_throttle_get_default_config(ospf_throttle_config_t *config);
+
+/**
+ * @brief Check a timing for consistency
+ *
+ * The short delay may not exceed the long one, nor the hold time the
+ * maximum wait, and TIME_TO_LEARN must be shorter than HOLDDOWN.
+ *
+ * @param config Timing
+ * @return STATUS_SUCCESS if usable, STATUS_INVALID_PARAMETER otherwise
+ */
+status_t ospf_throttle_validate_config(const ospf_throttle_config_t *config);
+
+/**
+ * @brief Prepare the SPF scheduler of an area
+ *
+ * @param backoff Scheduler
+ * @param config Timing, referenced rather than copied so a change applies at once
+ * @param run_spf Runs SPF for the area
+ * @param arg Passed to run_spf
+ */
+void ospf_spf_backoff_init(ospf_spf_backoff_t *backoff, const ospf_throttle_config_t *config,
+                           ospf_throttle_cb_t run_spf, void *arg);
+
+/**
+ * @brief Report an IGP event that requires an SPF run
+ *
+ * @param backoff Scheduler
+ */
+void ospf_spf_backoff_event(ospf_spf_backoff_t *backoff);
+
+/**
+ * @brief Stop the scheduler and return it to QUIET
+ *
+ * @param backoff Scheduler
+ */
+void ospf_spf_backoff_reset(ospf_spf_backoff_t *backoff);
+
+/**
+ * @brief Get the back-off state
+ *
+ * @param backoff Scheduler
+ * @return Current state
+ */
+ospf_spf_backoff_state_t ospf_spf_backoff_get_state(const ospf_spf_backoff_t *backoff);
+
+/**
+ * @brief Prepare the origination throttle of an LSA
+ *
+ * @param throttle Throttle
+ * @param config Timing, referenced rather than copied
+ * @param originate Builds and floods a new instance of the LSA
+ * @param arg Passed to originate
+ */
+void ospf_lsa_throttle_init(ospf_lsa_throttle_t *throttle, const ospf_throttle_config_t *config,
+                            ospf_throttle_cb_t originate, void *arg);
+
+/**
+ * @brief Ask for a new instance of the LSA
+ *
+ * @param throttle Throttle
+ * @return true if an origination was scheduled, false if one was pending already
+ */
+bool ospf_lsa_throttle_request(ospf_lsa_throttle_t *throttle);
+
+/**
+ * @brief Drop a pending origination
+ *
+ * @param throttle Throttle
+ * @return true if an origination was pending
+ */
+bool ospf_lsa_throttle_cancel(ospf_lsa_throttle_t *throttle);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_OSPF_THROTTLE_H */
@@ -0,0 +1,264 @@
+/**
+ * @file pim.h
+ * @brief PIM-SM router for IPv4 (RFC 7761), sparse-mode tree state only
+ *
+ * The router keeps PIM neighbors from Hellos, elects the DR of each
+ * interface, and keeps (*,G) and (S,G) state from the Join/Prune messages
+ * of downstream routers and the local membership reported by IGMP. Each
+ * route with downstream interfaces is kept joined towards its upstream
+ * neighbor, the RPF neighbor of the RP for (*,G) and of the source for
+ * (S,G), and is programmed into the multicast FIB (mcast_fib.h): the RPF
+ * interface as incoming interface, the joined interfaces as replication
+ * list. An (S,G) route inherits the interfaces of its (*,G) route.
+ *
+ * RPs are static, per group range. A prune on an interface with more than
+ * one neighbor takes effect after the J/P override interval, so another
+ * router on the LAN can keep the traffic with a join. Periodic joins are
+ * packed: every route with the same upstream neighbor goes in as few
+ * messages as fit. Not implemented: the Register mechanism (sources
+ * reach the tree through an RP that is also their first hop, or through
+ * (S,G) joins), Asserts, SPT switchover and BSR.
+ *
+ * The owner delivers the PIM messages received (IP protocol 103) to
+ * pim_input(), runs pim_process_timers() every few hundred milliseconds,
+ * and sends what the send callback gets, to ALL-PIM-ROUTERS with a TTL
+ * of 1. Unicast routing answers RPF questions through the rpf callback.
+ * A router is not thread-safe; one task owns it. The FIB routes it
+ * programs belong to the switch instance current when it is called.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_PIM_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_PIM_H
+
+#include "common/types.h"
+#include "common/error_codes.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PIM_MAX_INTERFACES          64
+#define PIM_MAX_NEIGHBORS           16      /**< Per interface */
+#define PIM_MAX_RPS                 16
+#define PIM_MAX_MESSAGE_LEN         1400
+#define PIM_NO_INTERFACE            0xFFFFFFFFu
+#define PIM_ALL_ROUTERS             0xE000000Du     /**< 224.0.0.13 */
+
+#define PIM_DEFAULT_HELLO_PERIOD_MS         30000
+#define PIM_DEFAULT_JOIN_PRUNE_PERIOD_MS    60000
+#define PIM_DEFAULT_DR_PRIORITY             1
+
+/* PIM message types (RFC 7761 4.9) */
+#define PIM_MSG_HELLO               0
+#define PIM_MSG_REGISTER            1
+#define PIM_MSG_REGISTER_STOP       2
+#define PIM_MSG_JOIN_PRUNE          3
+#define PIM_MSG_BOOTSTRAP           4
+#define PIM_MSG_ASSERT              5
+
+/**
+ * @brief Sends one PIM message
+ *
+ * @param ifindex Interface, as returned by pim_interface_add()
+ * @param dst Destination address, host order (PIM_ALL_ROUTERS)
+ * @param msg Message, PIM header included
+ * @param length Bytes at msg
+ * @param ctx Context from the router configuration
+ * @return STATUS_SUCCESS if sent
+ */
+typedef status_t (*pim_send_cb_t)(uint32_t ifindex, uint32_t dst, const uint8_t *msg, uint16_t length,
+                                  void *ctx);
+
+/**
+ * @brief Resolves the RPF interface and neighbor of an address
+ *
+ * @param address RP or source, host order
+ * @param[out] ifindex PIM interface of the unicast route to address
+ * @param[out] neighbor Next hop, host order, 0 if address is on the interface's subnet
+ * @param ctx Context from the router configuration
+ * @return STATUS_SUCCESS if there is a route over a PIM interface
+ */
+typedef status_t (*pim_rpf_cb_t)(uint32_t address, uint32_t *ifindex, uint32_t *neighbor, void *ctx);
+
+/* Router parameters */
+typedef struct {
+    uint32_t hello_period_ms;       /* 0 for PIM_DEFAULT_HELLO_PERIOD_MS */
+    uint32_t join_prune_period_ms;  /* 0 for PIM_DEFAULT_JOIN_PRUNE_PERIOD_MS */
+    pim_send_cb_t send;
+    pim_rpf_cb_t rpf;
+    void *ctx;                      /* Passed to send and rpf */
+} pim_config_t;
+
+/* Interface parameters; the FIB rewrite of the interface comes from here */
+typedef struct {
+    uint32_t address;               /* Host order */
+    port_id_t port_id;              /* Port or LAG */
+    vlan_id_t vlan_id;              /* VLAN of the interface */
+    bool tagged;                    /* Frames on the port carry a tag of vlan_id */
+    mac_addr_t mac;                 /* Router MAC of the interface */
+    uint32_t dr_priority;           /* 0 for PIM_DEFAULT_DR_PRIORITY */
+} pim_interface_config_t;
+
+/* Interface state */
+typedef struct {
+    uint32_t neighbors;
+    bool is_dr;
+    uint32_t dr_address;            /* Host order, our own address if is_dr */
+} pim_interface_info_t;
+
+/* Route state */
+typedef struct {
+    uint32_t rp;                    /* RP of the group, host order, 0 if unknown */
+    uint32_t upstream_if;           /* RPF interface, PIM_NO_INTERFACE if none */
+    uint32_t upstream_neighbor;     /* Joined neighbor, 0 if the route is joined to none */
+    uint64_t joined;                /* Interfaces with downstream join state, bit per ifindex */
+    uint64_t local;                 /* Interfaces with local members */
+    uint64_t oifs;                  /* Interfaces programmed in the FIB */
+} pim_route_info_t;
+
+/* Router counters */
+typedef struct {
+    uint32_t neighbors;
+    uint32_t routes;                /* (*,G) and (S,G) */
+    uint64_t hellos_rx;
+    uint64_t hellos_tx;
+    uint64_t join_prunes_rx;
+    uint64_t join_prunes_tx;
+    uint64_t joins_rx;              /* Join entries, all messages */
+    uint64_t prunes_rx;
+    uint64_t malformed;
+    uint64_t unsupported;           /* Register, Assert, BSR and other messages ignored */
+    uint64_t fib_errors;            /* FIB updates that failed */
+} pim_stats_t;
+
+/* Opaque router */
+typedef struct pim_router pim_router_t;
+
+/**
+ * @brief Create a router
+ *
+ * @param config Parameters, copied
+ * @return New router, or NULL if out of memory or send or rpf is missing
+ */
+pim_router_t *pim_router_create(const pim_config_t *config);
+
+/**
+ * @brief Free a router; the FIB routes it programmed are deleted
+ *
+ * @param router Router, may be NULL
+ */
+void pim_router_destroy(pim_router_t *router);
+
+/**
+ * @brief Enable PIM on an interface
+ *
+ * @param router Router
+ * @param config Interface parameters, copied
+ * @param[out] ifindex Interface index, below PIM_MAX_INTERFACES
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER,
+ *         STATUS_RESOURCE_EXHAUSTED if out of interfaces
+ */
+status_t pim_interface_add(pim_router_t *router, const pim_interface_config_t *config, uint32_t *ifindex);
+
+/**
+ * @brief Disable PIM on an interface; its join state and neighbors go
+ *
+ * @param router Router
+ * @param ifindex Interface
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t pim_interface_remove(pim_router_t *router, uint32_t ifindex);
+
+/**
+ * @brief Map a group range to an RP, replacing the range's previous RP
+ *
+ * Routes already joined keep their RP until their next periodic join.
+ *
+ * @param router Router
+ * @param prefix Group range, host order
+ * @param prefix_len 4..32
+ * @param rp RP address, host order
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER,
+ *         STATUS_RESOURCE_EXHAUSTED if out of ranges
+ */
+status_t pim_rp_add(pim_router_t *router, uint32_t prefix, uint8_t prefix_len, uint32_t rp);
+
+/**
+ * @brief Remove a group range
+ *
+ * @param router Router
+ * @param prefix Group range
+ * @param prefix_len Its length
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t pim_rp_remove(pim_router_t *router, uint32_t prefix, uint8_t prefix_len);
+
+/**
+ * @brief Report local members joining or leaving a group on an interface
+ *
+ * Called with IGMP state. Local members count only where the router is DR.
+ *
+ * @param router Router
+ * @param ifindex Interface
+ * @param source Source, host order, 0 for any source
+ * @param group Group, host order
+ * @param join true when the first member joins, false when the last leaves
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND, STATUS_INVALID_PARAMETER
+ *         (no RP for an any-source join), STATUS_NO_MEMORY
+ */
+status_t pim_local_membership(pim_router_t *router, uint32_t ifindex, uint32_t source, uint32_t group,
+                              bool join);
+
+/**
+ * @brief Process one PIM message received on an interface
+ *
+ * @param router Router
+ * @param ifindex Receiving interface
+ * @param src Sender address, host order
+ * @param msg Message, PIM header included
+ * @param length Bytes at msg
+ * @param now_ms Current time in milliseconds, the clock of pim_process_timers()
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND, STATUS_INVALID_PACKET
+ *         if malformed, STATUS_NOT_SUPPORTED for ignored message types,
+ *         STATUS_NO_MEMORY
+ */
+status_t pim_input(pim_router_t *router, uint32_t ifindex, uint32_t src, const uint8_t *msg, uint16_t length,
+                   uint64_t now_ms);
+
+/**
+ * @brief Send the Hellos and periodic joins that are due and expire state
+ *
+ * @param router Router
+ * @param now_ms Current time in milliseconds, any monotonic origin
+ */
+void pim_process_timers(pim_router_t *router, uint64_t now_ms);
+
+/**
+ * @brief Get the state of an interface
+ *
+ * @param router Router
+ * @param ifindex Interface
+ * @param[out] info State
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t pim_get_interface(const pim_router_t *router, uint32_t ifindex, pim_interface_info_t *info);
+
+/**
+ * @brief Get the state of a route
+ *
+ * @param router Router
+ * @param source Source, host order, 0 for (*,G)
+ * @param group Group, host order
+ * @param[out] info State
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t pim_get_route(const pim_router_t *router, uint32_t source, uint32_t group, pim_route_info_t *info);
+
+/**
+ * @brief Get router counters
+ *
+ * @param router Router
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t pim_get_stats(const pim_router_t *router, pim_stats_t *stats);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_PIM_H */
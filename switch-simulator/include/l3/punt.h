@@ -0,0 +1,151 @@
+/**
+ * @file punt.h
+ * @brief Control-plane punt path with per-protocol policers
+ *
+ * Packets addressed to the switch itself are not processed on the
+ * forwarding worker that received them. The worker charges the policer of
+ * the packet's protocol class and queues a shared reference to the packet
+ * (no payload copy) on that class's bounded queue; the punt thread drains
+ * the queues and hands the packets to the protocol handlers. An ARP or
+ * OSPF storm therefore costs the workers one policer update per packet,
+ * and a slow protocol handler only fills its own queue.
+ *
+ * Processes outside the simulator get the punted packets through the
+ * shared CPU trap ring (hal/cpu_trap.h) when one is open; the punt thread
+ * writes them there, so the workers pay nothing extra for it.
+ *
+ * ARP frames are punted by a burst stage of the packet pipeline at
+ * PUNT_PROCESSOR_PRIORITY and keep being bridged; IP packets for a local
+ * address are punted by the IP layer.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_PUNT_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_PUNT_H
+
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "hal/packet.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Defaults */
+#define PUNT_QUEUE_SIZE                 1024    /**< Slots of a class queue, a power of two */
+#define PUNT_DRAIN_BATCH                32      /**< Packets taken from one class per pass */
+#define PUNT_IDLE_SLEEP_US              100     /**< Punt thread sleep when every queue is empty */
+#define PUNT_PROCESSOR_PRIORITY         300     /**< Pipeline priority of the ARP punt stage */
+
+#define PUNT_RIP_UDP_PORT               520     /**< RIP (RFC 2453) */
+#define PUNT_RIPNG_UDP_PORT             521     /**< RIPng (RFC 2080) */
+#define PUNT_BFD_UDP_PORT               3784    /**< Single-hop BFD control (RFC 5881) */
+
+/* Protocol classes, each with its own policer and queue */
+typedef enum {
+    PUNT_CLASS_ARP = 0,             /* ARP frames */
+    PUNT_CLASS_ICMP,                /* ICMP and ICMPv6 other than Neighbor Discovery */
+    PUNT_CLASS_IGMP,                /* IGMP */
+    PUNT_CLASS_OSPF,                /* OSPF */
+    PUNT_CLASS_RIP,                 /* RIP and RIPng */
+    PUNT_CLASS_BFD,                 /* BFD control packets */
+    PUNT_CLASS_OTHER,               /* Any other TCP or UDP traffic to the switch */
+    PUNT_CLASS_COUNT
+} punt_class_t;
+
+/* Policer and queue settings of a class */
+typedef struct {
+    uint32_t rate;                  /* Packets per second, 0 drops the class */
+    uint32_t burst;                 /* Packets a quiet class may punt back to back (1..65535) */
+    uint32_t queue_limit;           /* Packets waiting for the punt thread (1..PUNT_QUEUE_SIZE) */
+} punt_policer_t;
+
+/* Punt statistics of a class */
+typedef struct {
+    uint64_t punted;                /* Packets queued for the punt thread */
+    uint64_t policed;               /* Packets refused by the policer */
+    uint64_t queue_drops;           /* Packets refused because the queue was at its limit */
+    uint64_t delivered;             /* Packets handed to the class handler */
+    uint64_t unhandled;             /* Packets dropped because the class had no handler (the trap ring still gets them) */
+    uint32_t depth;                 /* Packets queued now */
+} punt_stats_t;
+
+/**
+ * @brief Protocol handler of a class, run on the punt thread
+ *
+ * The packets are only lent to the handler; they are freed when it returns.
+ *
+ * @param packets Punted packets, in arrival order
+ * @param count Number of packets
+ * @param ctx Context given at registration
+ */
+typedef void (*punt_handler_t)(packet_buffer_t **packets, uint32_t count, void *ctx);
+
+/**
+ * @brief Create the class queues and start the punt thread
+ *
+ * ARP is handled by arp_handle_frames_bulk(); the other classes have no
+ * handler until one is registered. Registers the ARP punt stage when the
+ * packet pipeline is initialized.
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t punt_init(void);
+
+/**
+ * @brief Stop the punt thread and drop everything still queued
+ *
+ * @return STATUS_SUCCESS on success
+ */
+status_t punt_shutdown(void);
+
+/**
+ * @brief Get the default settings of a class
+ *
+ * @param cls Protocol class
+ * @param[out] policer Settings
+ * @return STATUS_SUCCESS on success, ERROR_INVALID_PARAMETER on a bad class
+ */
+status_t punt_get_default_policer(punt_class_t cls, punt_policer_t *policer);
+
+/**
+ * @brief Change the policer and queue limit of a class
+ *
+ * @param cls Protocol class
+ * @param policer New settings
+ * @return STATUS_SUCCESS on success, ERROR_INVALID_PARAMETER on bad settings
+ */
+status_t punt_set_policer(punt_class_t cls, const punt_policer_t *policer);
+
+/**
+ * @brief Set the protocol handler of a class
+ *
+ * @param cls Protocol class
+ * @param handler Handler, NULL to drop the class's packets after policing
+ * @param ctx Passed to the handler
+ * @return STATUS_SUCCESS on success, ERROR_INVALID_PARAMETER on a bad class
+ */
+status_t punt_set_handler(punt_class_t cls, punt_handler_t handler, void *ctx);
+
+/**
+ * @brief Queue a packet for the control plane
+ *
+ * Safe to call from any forwarding worker that owns the packet. The queue
+ * gets a shared clone; the caller keeps the packet and may go on using it.
+ *
+ * @param packet Packet to punt
+ * @param cls Protocol class
+ * @return STATUS_SUCCESS if the packet was queued,
+ *         ERROR_PUNT_POLICED if the class is over its rate,
+ *         STATUS_RESOURCE_EXCEEDED if the class queue is full,
+ *         other error code otherwise
+ */
+status_t punt_packet(const packet_buffer_t *packet, punt_class_t cls);
+
+/**
+ * @brief Get the punt statistics of a class
+ *
+ * @param cls Protocol class
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, ERROR_INVALID_PARAMETER on bad arguments
+ */
+status_t punt_get_stats(punt_class_t cls, punt_stats_t *stats);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_PUNT_H */
@@ -0,0 +1,205 @@
+/**
+ * @file rip_db.h
+ * @brief Hashed RIP route database with timer buckets and triggered updates
+ *
+ * RIP routes are kept in a hash table keyed by (destination, mask), so
+ * each RTE of a Response costs one lookup however many routes there are.
+ * Every route also sits in one bucket of a one-second timing wheel, at its
+ * timeout while it is valid and at its garbage-collection deadline once it
+ * is not; rip_db_expire() only visits the buckets of the seconds that
+ * passed.
+ *
+ * Changed routes are collected for the next triggered update instead of
+ * being sent one by one (RFC 2453 3.10.1): after an update goes out the
+ * next triggered one waits a random 1 to 5 seconds, and whatever changed
+ * meanwhile leaves in that single update, as one burst of Responses per
+ * interface.
+ *
+ * A database is not thread-safe; the RIP task owns it.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_RIP_DB_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_RIP_DB_H
+
+#include "common/types.h"
+#include "common/error_codes.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RIP_DB_INFINITY             16      /**< Unreachable metric */
+#define RIP_DB_TIMEOUT              180     /**< Route timeout, seconds (RFC 2453 3.8) */
+#define RIP_DB_GARBAGE_TIME         120     /**< Garbage-collection time, seconds */
+#define RIP_DB_MAX_RTES             25      /**< RTEs per Response (RFC 2453 3.6) */
+#define RIP_DB_TRIGGER_MIN          1       /**< Triggered update hold-off, seconds */
+#define RIP_DB_TRIGGER_MAX          5
+
+/* What an update did to the database */
+typedef enum {
+    RIP_DB_UNCHANGED = 0,           /* Nothing to tell the FIB or the neighbors */
+    RIP_DB_ADDED,                   /* A new or revived route: add it to the FIB */
+    RIP_DB_CHANGED,                 /* Another metric or next hop: update the FIB */
+    RIP_DB_WITHDRAWN                /* The route became unreachable: remove it from the FIB */
+} rip_db_change_t;
+
+/* Deadlines reported by rip_db_expire() */
+typedef enum {
+    RIP_DB_EVENT_TIMEOUT = 0,       /* No update for the timeout: now unreachable */
+    RIP_DB_EVENT_DELETE             /* Garbage collection ended: the route is freed after the callback */
+} rip_db_event_t;
+
+/* One Route Table Entry, host order */
+typedef struct {
+    uint32_t destination;
+    uint32_t mask;
+    uint32_t next_hop;              /* 0 for the sender of the Response */
+    uint32_t metric;                /* 1 to RIP_DB_INFINITY */
+} rip_db_rte_t;
+
+/* One route */
+typedef struct rip_db_route {
+    uint32_t destination;           /* Host order */
+    uint32_t mask;
+    uint32_t next_hop;
+    uint32_t metric;
+    uint32_t interface_index;       /* Interface the route was learned on */
+    bool valid;                     /* false while garbage collection runs */
+    bool changed;                   /* Goes out in the next triggered update */
+    /* Private to the database */
+    struct rip_db_route *hash_next;
+    struct rip_db_route *changed_next;
+    struct rip_db_route *wheel_prev;
+    struct rip_db_route *wheel_next;
+    uint32_t deadline;              /* Second of the timeout or the deletion */
+    uint8_t wheel_state;
+} rip_db_route_t;
+
+/* Opaque route database */
+typedef struct rip_db rip_db_t;
+
+/**
+ * @brief Called for every deadline that passed
+ *
+ * The callback must not change the database.
+ *
+ * @param route Route that reached the deadline
+ * @param event Which deadline
+ * @param ctx Context given to rip_db_expire()
+ */
+typedef void (*rip_db_expire_cb_t)(const rip_db_route_t *route, rip_db_event_t event, void *ctx);
+
+/**
+ * @brief Send one Response
+ *
+ * @param interface_index Interface to send on
+ * @param rtes Entries, 1 to RIP_DB_MAX_RTES of them
+ * @param count Number of entries
+ * @param ctx Context given to rip_db_send_update()
+ * @return STATUS_SUCCESS if sent; an error ends the burst
+ */
+typedef status_t (*rip_db_send_cb_t)(uint32_t interface_index, const rip_db_rte_t *rtes,
+                                     uint32_t count, void *ctx);
+
+/**
+ * @brief Create an empty database
+ *
+ * @param now Current time, seconds
+ * @param seed Seed of the triggered update hold-off
+ * @return New database, or NULL if out of memory
+ */
+rip_db_t *rip_db_create(uint32_t now, uint32_t seed);
+
+/**
+ * @brief Free a database and its routes
+ *
+ * @param db Database, may be NULL
+ */
+void rip_db_destroy(rip_db_t *db);
+
+/**
+ * @brief Apply one RTE of a Response (RFC 2453 3.9.2)
+ *
+ * The metric already includes the cost of the interface it came in on.
+ * An RTE from the route's current next hop refreshes its timeout and is
+ * taken whatever its metric; one from another router only replaces a
+ * worse route.
+ *
+ * @param db Database
+ * @param rte Entry, next_hop resolved to the sender if it was 0
+ * @param interface_index Interface the Response came in on
+ * @param now Current time, seconds
+ * @param[out] change What the FIB should do, may be NULL
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t rip_db_update(rip_db_t *db, const rip_db_rte_t *rte, uint32_t interface_index,
+                       uint32_t now, rip_db_change_t *change);
+
+/**
+ * @brief Find a route
+ *
+ * @param db Database
+ * @param destination Destination, host order
+ * @param mask Mask, host order
+ * @return The route, NULL if unknown; valid until it is deleted
+ */
+const rip_db_route_t *rip_db_lookup(const rip_db_t *db, uint32_t destination, uint32_t mask);
+
+/**
+ * @brief Time out and delete the routes whose deadlines passed
+ *
+ * A timed-out route is advertised as unreachable in the next triggered
+ * update and deleted RIP_DB_GARBAGE_TIME later.
+ *
+ * @param db Database
+ * @param now Current time, seconds
+ * @param cb Called for each deadline, may be NULL
+ * @param ctx Passed to cb
+ * @return Number of deadlines reported
+ */
+uint32_t rip_db_expire(rip_db_t *db, uint32_t now, rip_db_expire_cb_t cb, void *ctx);
+
+/**
+ * @brief Check whether a triggered update should go out now
+ *
+ * @param db Database
+ * @param now Current time, seconds
+ * @return true if routes changed and the hold-off is over
+ */
+bool rip_db_trigger_due(const rip_db_t *db, uint32_t now);
+
+/**
+ * @brief Send the routes to one interface as a burst of Responses
+ *
+ * Routes learned on the interface are left out (split horizon). A full
+ * update also carries the routes under garbage collection, at metric
+ * RIP_DB_INFINITY.
+ *
+ * @param db Database
+ * @param interface_index Interface to send on
+ * @param changed_only Send only the routes changed since the last update
+ * @param send Called for each Response
+ * @param ctx Passed to send
+ * @return Number of Responses sent
+ */
+uint32_t rip_db_send_update(const rip_db_t *db, uint32_t interface_index, bool changed_only,
+                            rip_db_send_cb_t send, void *ctx);
+
+/**
+ * @brief Record that an update went out on every interface
+ *
+ * Clears the changed routes and starts the triggered update hold-off. A
+ * regular update covers any triggered update still pending.
+ *
+ * @param db Database
+ * @param now Current time, seconds
+ */
+void rip_db_updates_sent(rip_db_t *db, uint32_t now);
+
+/**
+ * @brief Number of routes, the ones under garbage collection included
+ *
+ * @param db Database
+ * @return Route count
+ */
+uint32_t rip_db_count(const rip_db_t *db);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_RIP_DB_H */
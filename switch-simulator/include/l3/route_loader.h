@@ -0,0 +1,103 @@
+/**
+ * @file route_loader.h
+ * @brief Bulk routing table loads from MRT dumps and route image files
+ *
+ * A load maps the file, splits it at record boundaries into one slice per
+ * parser thread and installs the parsed slices, in file order, into one
+ * routing table batch, so the FIB and hardware see a single commit. Slices
+ * are installed as their threads finish, while later slices still parse.
+ *
+ * Two formats are read:
+ *  - MRT TABLE_DUMP_V2 (RFC 6396) RIB_IPV4_UNICAST and RIB_IPV6_UNICAST
+ *    records, one route per prefix, as dumped by route collectors;
+ *  - route images, written by route_loader_dump(): a 16-byte header and
+ *    fixed 40-byte records, so reload needs no record scan.
+ *
+ * Route image layout, all fields in network order:
+ *
+ *   header: magic "SWRT", version (2), record size (2), route count (4), reserved (4)
+ *   record: family 4/6 (1), prefix length (1), source (1), reserved (1),
+ *           interface (2), metric (2), prefix (16), next hop (16)
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_ROUTE_LOADER_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_ROUTE_LOADER_H
+
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "l3/routing_table.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ROUTE_LOADER_MAX_THREADS       16
+#define ROUTE_LOADER_ANY_PEER          0xFFFF  /**< Take the first RIB entry of each prefix */
+#define ROUTE_LOADER_IMAGE_MAGIC       "SWRT"
+#define ROUTE_LOADER_IMAGE_VERSION     1
+#define ROUTE_LOADER_IMAGE_HEADER_LEN  16
+#define ROUTE_LOADER_IMAGE_RECORD_LEN  40
+
+/* File formats */
+typedef enum {
+    ROUTE_LOADER_FORMAT_AUTO = 0,   /* Route image if the magic matches, MRT otherwise */
+    ROUTE_LOADER_FORMAT_MRT,
+    ROUTE_LOADER_FORMAT_IMAGE
+} route_loader_format_t;
+
+/* Load parameters */
+typedef struct {
+    route_loader_format_t format;
+    uint32_t threads;               /* Parser threads, 0 for one per online CPU */
+    uint16_t interface_index;       /* MRT: interface the routes are installed on */
+    route_source_t source;          /* MRT: source of the routes */
+    uint16_t peer_index;            /* MRT: peer whose path is taken, or ROUTE_LOADER_ANY_PEER */
+} route_loader_options_t;
+
+/* Load results */
+typedef struct {
+    uint64_t records;               /* Records in the file */
+    uint32_t routes_parsed;
+    uint32_t routes_added;          /* Routes new to the routing table */
+    uint32_t skipped;               /* Records of other types, prefixes without the peer */
+    uint32_t malformed;             /* Records that did not decode */
+    uint32_t threads;               /* Parser threads used */
+    uint64_t parse_us;              /* Until the last slice was parsed */
+    uint64_t total_us;
+} route_loader_stats_t;
+
+/**
+ * @brief Get the default load parameters
+ *
+ * Auto-detected format, one thread per CPU, static routes on interface 0
+ * for MRT input, first path of each prefix.
+ *
+ * @param[out] options Parameters
+ */
+void route_loader_get_default_options(route_loader_options_t *options);
+
+/**
+ * @brief Load a route file into the routing table
+ *
+ * Joins the routing table batch in progress if there is one, and commits
+ * a batch of its own otherwise. Malformed records are counted and skipped;
+ * a truncated MRT file loads up to the truncated record.
+ *
+ * @param path File to load
+ * @param options Parameters, NULL for the defaults
+ * @param[out] stats Results, may be NULL
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NOT_FOUND
+ *         if the file cannot be opened, STATUS_NO_MEMORY, or the routing table error
+ */
+status_t route_loader_load(const char *path, const route_loader_options_t *options,
+                           route_loader_stats_t *stats);
+
+/**
+ * @brief Write every route of the default VRF to a route image
+ *
+ * @param path File to write, replaced if it exists
+ * @param[out] routes Routes written, may be NULL
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_FAILURE
+ *         if the file cannot be written, or the routing table error
+ */
+status_t route_loader_dump(const char *path, uint32_t *routes);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_L3_ROUTE_LOADER_H */
@@ -9,10 +9,10 @@
 
 #include "../common/types.h"
 #include "../common/error_codes.h"
+#include "../common/table_cursor.h"
 #include "../hal/port.h"
 #include "../l3/ip.h"
 
-#define MAX_ROUTES 1024
 #define MAX_INTERFACE_NAME_LEN 32
 
 /** Route types */
@@ -78,14 +78,57 @@ typedef struct {
     uint32_t age;                        /**< Age in seconds */
 } route_entry_t;
 
-/** Routing table */
+/** Routing table summary; routes themselves live in the RIB and FIB */
 typedef struct {
-    route_entry_t routes[MAX_ROUTES];
     uint32_t route_count;
     uint32_t last_update_time;
     bool changed;
 } routing_table_t;
 
+/** Routing table statistics */
+typedef struct {
+    uint32_t total_routes;               /**< Routes in the table */
+    uint32_t ipv4_routes;                /**< IPv4 routes */
+    uint32_t ipv6_routes;                /**< IPv6 routes */
+    uint32_t max_routes;                 /**< RIB entries allocated, grows on demand */
+    bool hw_sync_enabled;                /**< Whether routes are pushed to hardware */
+    uint64_t ipv4_fib_memory;            /**< Bytes held by the IPv4 DIR-24-8 FIB */
+    uint64_t ipv6_lpm_memory;            /**< Bytes held by the IPv6 multibit trie */
+    uint32_t ipv6_lpm_nodes;             /**< IPv6 trie nodes in use */
+    uint32_t fib_nodes;                  /**< Trie nodes in use, both families */
+    uint32_t fib_folded_nodes;           /**< Nodes folded away by FIB compression; the trie
+                                              would need fib_nodes + fib_folded_nodes without it */
+    uint64_t rib_memory;                 /**< Bytes held by RIB entries and buckets */
+    uint32_t fib_prefixes;               /**< Prefixes installed in the FIB */
+    uint32_t fib_nexthops;               /**< Distinct next hops shared by FIB prefixes */
+    uint32_t fib_nhgroups;               /**< Distinct next-hop groups shared by FIB prefixes */
+    uint64_t nexthop_link_changes;       /**< Next hops switched by port link events */
+    bool lookup_cache_enabled;           /**< Whether lookups go through the worker caches */
+    uint64_t lookup_cache_hits;          /**< Lookups answered from a worker cache */
+    uint64_t lookup_cache_misses;        /**< Cached lookups that walked the FIB */
+    uint32_t stale_routes;               /**< Restored routes not yet refreshed by their source */
+    uint32_t hw_queue_depth;             /**< Prefixes waiting to be programmed to hardware */
+    uint64_t hw_ops_queued;              /**< Hardware operations queued */
+    uint64_t hw_ops_merged;              /**< Operations folded into a queued one for the same prefix */
+    uint64_t hw_ops_cancelled;           /**< Prefixes whose queued operations cancelled out */
+    uint64_t hw_ops_programmed;          /**< Hardware writes made */
+    uint64_t hw_ops_failed;              /**< Routes the hardware route table had no room for */
+    uint64_t hw_queue_stalls;            /**< Times a writer waited for room in the queue */
+    uint64_t hw_batches;                 /**< Batches programmed */
+    uint64_t hw_batch_last_ns;           /**< Time taken by the last batch */
+    uint64_t hw_batch_max_ns;            /**< Time taken by the slowest batch */
+    uint64_t hw_batch_total_ns;          /**< Time taken by all batches */
+} routing_table_stats_t;
+
+/** Flow fields hashed to pick one of several equal-cost paths */
+typedef struct {
+    ip_addr_t src_addr;                  /**< Source address */
+    ip_addr_t dst_addr;                  /**< Destination address */
+    uint8_t protocol;                    /**< IP protocol */
+    uint16_t src_port;                   /**< L4 source port, 0 if none */
+    uint16_t dst_port;                   /**< L4 destination port, 0 if none */
+} routing_flow_t;
+
 /* Helper macros for accessing next hop */
 #define ROUTE_GET_IPV4_NEXT_HOP(route) \
     ((route)->is_ipv6 ? NULL : &(route)->route.ipv4.gateway)
@@ -106,6 +149,100 @@ uint32_t routing_table_get_count(const routing_table_t *table);
 status_t routing_table_get_routes_by_type(const routing_table_t *table, route_type_t type, route_entry_t *routes, uint32_t max_routes, uint32_t *actual_routes);
 status_t routing_table_get_all_routes(const routing_table_t *table, route_entry_t *routes, uint32_t max_routes, uint32_t *actual_routes);
 status_t routing_table_clear(routing_table_t *table);
+/* Withdraws every route of every source, in all VRFs */
+status_t routing_table_flush(void);
+status_t routing_table_get_stats(routing_table_stats_t *stats);
+
+/* Per-worker destination caches in front of lookups, retired whenever the FIB changes */
+status_t routing_table_set_lookup_cache(bool enable);
+
+/* Bumped after every FIB or next-hop change, see routing_table_get_generation() */
+uint32_t routing_table_get_generation(void);
+
+/* Hardware writes are queued and programmed in batches; waits until everything queued is written */
+status_t routing_table_hw_sync_flush(void);
+
+/* Batched updates: changed prefixes reach the FIB and hardware on commit */
+status_t routing_table_begin_batch(void);
+status_t routing_table_commit_batch(void);
+
+/* Paths offered per source; the source's route type sets the administrative distance */
+typedef route_type_t route_source_t;
+status_t routing_add_route(const ip_addr_t *prefix, uint8_t prefix_len, ip_addr_type_t type,
+                           const ip_addr_t *next_hop, uint16_t interface_index,
+                           uint16_t metric, route_source_t route_source);
+status_t routing_remove_route_source(const ip_addr_t *prefix, uint8_t prefix_len, ip_addr_type_t type,
+                                     route_source_t route_source);
+status_t routing_lookup(const ip_addr_t *dest_addr, ip_addr_type_t type, route_entry_t *route_info);
+
+/* Route in exported form, for bulk loads and walks of the default VRF */
+typedef struct {
+    ip_addr_t prefix;                    /**< Network address */
+    ip_addr_t next_hop;                  /**< Next hop address */
+    ip_addr_type_t type;                 /**< Address family of both */
+    uint8_t prefix_len;                  /**< Prefix length */
+    uint16_t interface_index;            /**< Outgoing interface */
+    uint16_t metric;                     /**< Route metric */
+    route_source_t source;               /**< Source, sets the administrative distance */
+} routing_route_t;
+
+typedef void (*routing_walk_cb_t)(const routing_route_t *route, void *ctx);
+status_t routing_table_add_routes(const routing_route_t *routes, uint32_t count, uint32_t *added);
+status_t routing_add_routes_bulk(const routing_route_t *routes, uint32_t count, uint32_t *added);
+/* Bulk add or remove with a status per route, one lock hold and one FIB commit */
+status_t routing_table_update_routes(const routing_route_t *routes, uint32_t count, bool remove,
+                                     bool stop_on_error, status_t *statuses);
+status_t routing_table_walk(routing_walk_cb_t cb, void *ctx);
+/* The walk a page at a time, holding the lock per page; from TABLE_CURSOR_START until TABLE_CURSOR_END */
+status_t routing_table_get_routes_page(table_cursor_t *cursor, routing_route_t *routes, uint32_t max_routes,
+                                       uint32_t *count);
+
+/* Warm restart: restored routes forward at once and stay stale until their source adds them again */
+status_t routing_table_restore_routes(const routing_route_t *routes, uint32_t count, uint32_t *added);
+status_t routing_table_sweep_stale(uint32_t *removed);
+
+/* ECMP forwarding through shared next-hop groups; lookups take no lock and may run on any thread */
+uint32_t routing_flow_hash(const routing_flow_t *flow, ip_addr_type_t type);
+status_t routing_lookup_nexthop(const ip_addr_t *dest_addr, ip_addr_type_t type, uint32_t flow_hash,
+                                ip_addr_t *next_hop, uint16_t *interface_index);
+status_t routing_set_nexthop_state(const ip_addr_t *next_hop, ip_addr_type_t type,
+                                   uint16_t interface_index, bool up);
+/* Loop-free alternate of a source's route, taking over its group once every path is down */
+status_t routing_set_backup_nexthop(const ip_addr_t *prefix, uint8_t prefix_len, ip_addr_type_t type,
+                                    route_source_t route_source, const ip_addr_t *backup,
+                                    uint16_t interface_index);
+
+/* Burst lookups: trie levels are fetched for the whole burst with prefetch */
+#define ROUTING_LOOKUP_BULK_MAX 64
+status_t routing_lookup_bulk(const ip_addr_t *dst, uint32_t n, ip_addr_type_t type,
+                             uint32_t *nh_index, uint64_t *miss_mask);
+status_t routing_nexthop_select(uint32_t nh_index, uint32_t flow_hash,
+                                ip_addr_t *next_hop, uint16_t *interface_index);
+
+/* VRFs: a FIB per VRF over shared next hops; the functions above act on the default VRF */
+#define ROUTING_VRF_DEFAULT 0
+#define ROUTING_MAX_VRFS 1024
+#define ROUTING_MAX_INTERFACES 65536
+status_t routing_vrf_create(uint16_t vrf_id);
+status_t routing_vrf_delete(uint16_t vrf_id);
+status_t routing_vrf_add_route(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t prefix_len,
+                               ip_addr_type_t type, const ip_addr_t *next_hop, uint16_t interface_index,
+                               uint16_t metric, route_source_t route_source);
+/* route_source NULL removes the candidates of every source */
+status_t routing_vrf_remove_route(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t prefix_len,
+                                  ip_addr_type_t type, const route_source_t *route_source);
+status_t routing_interface_set_vrf(uint16_t interface_index, uint16_t vrf_id);
+uint16_t routing_interface_get_vrf(uint16_t interface_index);
+status_t routing_vrf_leak_route(uint16_t src_vrf, const ip_addr_t *prefix, uint8_t prefix_len,
+                                ip_addr_type_t type, uint16_t dst_vrf);
+status_t routing_vrf_unleak_route(uint16_t src_vrf, const ip_addr_t *prefix, uint8_t prefix_len,
+                                  ip_addr_type_t type, uint16_t dst_vrf);
+status_t routing_vrf_lookup(uint16_t vrf_id, const ip_addr_t *dest_addr, ip_addr_type_t type,
+                            route_entry_t *route_info);
+status_t routing_vrf_lookup_nexthop(uint16_t vrf_id, const ip_addr_t *dest_addr, ip_addr_type_t type,
+                                    uint32_t flow_hash, ip_addr_t *next_hop, uint16_t *interface_index);
+status_t routing_vrf_lookup_bulk(uint16_t vrf_id, const ip_addr_t *dst, uint32_t n, ip_addr_type_t type,
+                                 uint32_t *nh_index, uint64_t *miss_mask);
 
 /* Helper for static route creation (IPv4) */
 status_t routing_table_create_static_route(ipv4_addr_t destination, ipv4_addr_t netmask,
@@ -0,0 +1,226 @@
+/**
+ * @file bulk_api.h
+ * @brief Column-array entry points for bulk table reads and writes
+ *
+ * Each call moves a whole table, or a whole batch of changes, in one
+ * function call. Tables are passed as struct-of-arrays: a struct of
+ * pointers to caller-owned arrays, one array per field, all indexed by
+ * row. Foreign function callers such as the Python API can then hand
+ * numpy arrays or ctypes buffers straight to C and view the results in
+ * place, with no per-row call and no copy.
+ *
+ * On reads any column pointer may be NULL to skip that field. If the
+ * table holds more rows than the capacity given, *count is set to the
+ * rows needed and STATUS_OUT_OF_BOUNDS returned, as mac_table_export()
+ * does; the columns then hold no complete result. The _page reads
+ * instead fill the columns with the next rows from a cursor (see
+ * table_cursor.h), so a table of any size streams through columns of a
+ * fixed size.
+ *
+ * On writes each row gets its own status in statuses (may be NULL); the
+ * return value is the error of the last row that failed.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_MANAGEMENT_BULK_API_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_MANAGEMENT_BULK_API_H
+
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/table_cursor.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BULK_ADDR_LEN           16      /**< Bytes of an address column entry */
+
+/**
+ * @brief Routes, one row per path
+ *
+ * Addresses are in network byte order; IPv4 uses the first 4 bytes.
+ */
+typedef struct {
+    uint8_t (*prefix)[BULK_ADDR_LEN];   /**< Network address */
+    uint8_t (*next_hop)[BULK_ADDR_LEN]; /**< Next hop, zero for none */
+    uint8_t *is_ipv6;                   /**< 0 for IPv4, 1 for IPv6 */
+    uint8_t *prefix_len;
+    uint16_t *interface;                /**< Outgoing interface */
+    uint16_t *metric;
+    uint8_t *source;                    /**< route_source_t; writes may leave it NULL for static */
+} bulk_route_columns_t;
+
+/**
+ * @brief MAC table entries
+ */
+typedef struct {
+    uint8_t (*mac)[MAC_ADDR_LEN];
+    uint16_t *vlan_id;
+    uint16_t *port_id;
+    uint8_t *type;                      /**< mac_entry_type_t */
+    uint32_t *age_timestamp;
+} bulk_mac_columns_t;
+
+/**
+ * @brief VLAN memberships, one row per port of a VLAN
+ */
+typedef struct {
+    uint16_t *vlan_id;
+    uint16_t *port_id;
+    uint8_t *tagged;                    /**< 1 tagged, 0 untagged; ignored on removal */
+} bulk_vlan_member_columns_t;
+
+/**
+ * @brief Rows of the port counter matrix of bulk_read_port_counters()
+ */
+typedef enum {
+    BULK_PORT_RX_PACKETS = 0,
+    BULK_PORT_TX_PACKETS,
+    BULK_PORT_RX_BYTES,
+    BULK_PORT_TX_BYTES,
+    BULK_PORT_RX_ERRORS,
+    BULK_PORT_TX_ERRORS,
+    BULK_PORT_RX_DROPS,
+    BULK_PORT_TX_DROPS,
+    BULK_PORT_RX_UNICAST,
+    BULK_PORT_TX_UNICAST,
+    BULK_PORT_RX_BROADCAST,
+    BULK_PORT_TX_BROADCAST,
+    BULK_PORT_RX_MULTICAST,
+    BULK_PORT_TX_MULTICAST,
+    BULK_PORT_COLLISIONS,
+    BULK_PORT_COUNTER_COUNT
+} bulk_port_counter_t;
+
+/**
+ * @brief Rows of the VLAN counter matrix of bulk_read_vlan_counters()
+ */
+typedef enum {
+    BULK_VLAN_RX_PACKETS = 0,
+    BULK_VLAN_RX_BYTES,
+    BULK_VLAN_TX_PACKETS,
+    BULK_VLAN_TX_BYTES,
+    BULK_VLAN_COUNTER_COUNT
+} bulk_vlan_counter_t;
+
+/**
+ * @brief Add or remove routes in one routing table batch
+ *
+ * Removal takes every path of the prefix from the row's source.
+ *
+ * @param routes Route columns; next_hop, interface, metric and source may be NULL
+ * @param count Number of rows
+ * @param remove Remove instead of add
+ * @param statuses Status of each row, may be NULL
+ * @return status_t STATUS_SUCCESS, or the error of the last row that failed
+ */
+status_t bulk_update_routes(const bulk_route_columns_t *routes, uint32_t count, bool remove,
+                            status_t *statuses);
+
+/**
+ * @brief Read every route of the default VRF
+ *
+ * @param routes Route columns to fill
+ * @param capacity Rows the columns hold
+ * @param count Receives the rows written, or the rows needed
+ * @return status_t STATUS_SUCCESS, STATUS_OUT_OF_BOUNDS if capacity is too small
+ */
+status_t bulk_read_routes(const bulk_route_columns_t *routes, uint32_t capacity, uint32_t *count);
+
+/**
+ * @brief Read the next rows of the default VRF, a routing table page at a time
+ *
+ * @param routes Route columns to fill
+ * @param capacity Rows the columns hold
+ * @param cursor TABLE_CURSOR_START to begin; TABLE_CURSOR_END once every route was read
+ * @param count Receives the rows written
+ * @return status_t STATUS_SUCCESS, or the error of routing_table_get_routes_page()
+ */
+status_t bulk_read_routes_page(const bulk_route_columns_t *routes, uint32_t capacity, table_cursor_t *cursor,
+                               uint32_t *count);
+
+/**
+ * @brief Add or delete static MAC entries
+ *
+ * @param entries MAC columns; port_id is ignored on delete, type and age_timestamp always
+ * @param count Number of rows
+ * @param remove Delete instead of add
+ * @param statuses Status of each row, may be NULL
+ * @return status_t STATUS_SUCCESS, or the error of the last row that failed
+ */
+status_t bulk_update_mac_entries(const bulk_mac_columns_t *entries, uint32_t count, bool remove,
+                                 status_t *statuses);
+
+/**
+ * @brief Read the MAC table from a snapshot
+ *
+ * @param entries MAC columns to fill, sorted by MAC address and VLAN
+ * @param capacity Rows the columns hold
+ * @param count Receives the rows written, or the rows needed
+ * @return status_t STATUS_SUCCESS, STATUS_OUT_OF_BOUNDS if capacity is too small
+ */
+status_t bulk_read_mac_entries(const bulk_mac_columns_t *entries, uint32_t capacity, uint32_t *count);
+
+/**
+ * @brief Read the next rows of the MAC table, without a snapshot
+ *
+ * @param entries MAC columns to fill, in no particular order
+ * @param capacity Rows the columns hold
+ * @param cursor TABLE_CURSOR_START to begin; TABLE_CURSOR_END once every entry was read
+ * @param count Receives the rows written
+ * @return status_t STATUS_SUCCESS, or the error of mac_table_get_entries_page()
+ */
+status_t bulk_read_mac_entries_page(const bulk_mac_columns_t *entries, uint32_t capacity, table_cursor_t *cursor,
+                                    uint32_t *count);
+
+/**
+ * @brief Add or remove VLAN memberships through the VLAN bulk calls
+ *
+ * @param members Membership columns; tagged may be NULL for untagged
+ * @param count Number of rows
+ * @param remove Remove instead of add
+ * @param statuses Status of each row, may be NULL
+ * @return status_t STATUS_SUCCESS, or the error of the last row that failed
+ */
+status_t bulk_update_vlan_members(const bulk_vlan_member_columns_t *members, uint32_t count,
+                                  bool remove, status_t *statuses);
+
+/**
+ * @brief Read the memberships of every active VLAN, by VLAN then port
+ *
+ * @param members Membership columns to fill
+ * @param capacity Rows the columns hold
+ * @param count Receives the rows written, or the rows needed
+ * @return status_t STATUS_SUCCESS, STATUS_OUT_OF_BOUNDS if capacity is too small
+ */
+status_t bulk_read_vlan_members(const bulk_vlan_member_columns_t *members, uint32_t capacity,
+                                uint32_t *count);
+
+/**
+ * @brief Read the counters of a list of ports
+ *
+ * counters is a BULK_PORT_COUNTER_COUNT x count matrix, row major:
+ * counter c of port port_ids[i] is counters[c * count + i]. Ports whose
+ * counters cannot be read get zeros.
+ *
+ * @param port_ids Ports
+ * @param count Number of ports
+ * @param counters Output matrix
+ * @param statuses Status of each port, may be NULL
+ * @return status_t STATUS_SUCCESS, or the error of the last port that failed
+ */
+status_t bulk_read_port_counters(const uint16_t *port_ids, uint32_t count, uint64_t *counters,
+                                 status_t *statuses);
+
+/**
+ * @brief Read the counters of a list of VLANs
+ *
+ * Same layout as bulk_read_port_counters() with BULK_VLAN_COUNTER_COUNT rows.
+ *
+ * @param vlan_ids VLANs
+ * @param count Number of VLANs
+ * @param counters Output matrix
+ * @param statuses Status of each VLAN, may be NULL
+ * @return status_t STATUS_SUCCESS, or the error of the last VLAN that failed
+ */
+status_t bulk_read_vlan_counters(const uint16_t *vlan_ids, uint32_t count, uint64_t *counters,
+                                 status_t *statuses);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_MANAGEMENT_BULK_API_H */
@@ -0,0 +1,45 @@
+/**
+ * @file config_manager.h
+ * @brief Configuration manager: startup and running configuration
+ *
+ * The running configuration is kept as a config_model_t. Loading a
+ * configuration, changing a parameter or resetting to the defaults
+ * applies only the objects that differ from the running configuration,
+ * see config_model.h.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_MANAGEMENT_CONFIG_MANAGER_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_MANAGEMENT_CONFIG_MANAGER_H
+
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "management/config_model.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+status_t config_manager_init(void);
+status_t config_manager_deinit(void);
+
+/* Apply the startup configuration file; STATUS_NOT_FOUND if there is none */
+status_t config_manager_load_startup_config(void);
+
+/*
+ * Queue a snapshot of the running configuration to be written as the
+ * startup configuration by a background thread; returns once queued.
+ * Snapshots queued while a write is in progress are coalesced.
+ */
+status_t config_manager_save_startup_config(void);
+/* Wait until queued saves are written; the status of the last write */
+status_t config_manager_wait_for_save(void);
+
+/* Apply a configuration given as JSON text */
+status_t config_manager_apply_json(const char *config_data, size_t data_size, config_diff_stats_t *stats);
+
+/* Parameters as named in config_model.h */
+status_t config_manager_set_param(const char *key, const char *value);
+status_t config_manager_get_param(const char *key, char *value, size_t value_size);
+
+status_t config_manager_reset_to_defaults(void);
+bool config_manager_is_modified(void);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_MANAGEMENT_CONFIG_MANAGER_H */
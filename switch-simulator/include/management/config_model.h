@@ -0,0 +1,148 @@
+/**
+ * @file config_model.h
+ * @brief Switch configuration as objects, and incremental apply of changes
+ *
+ * A configuration is parsed from JSON into a model of the objects it
+ * owns: the enabled ports, the VLANs with their members and the static
+ * routes. Applying a new model compares it with the running one and
+ * changes only the objects that differ, in dependency order: routes,
+ * members, VLANs and ports that went away are removed first, then ports,
+ * VLANs, members and routes are added. Members go through the VLAN bulk
+ * calls and routes through one routing table batch, so a prefix whose
+ * paths change is never withdrawn from the FIB on the way.
+ *
+ * Objects the model does not list are left alone. On the first apply the
+ * running model is empty and every object of the configuration is
+ * applied; applying the same configuration again changes nothing.
+ *
+ * The JSON layout:
+ *
+ *   {
+ *     "switch": {
+ *       "name": "SwitchSimulator",
+ *       "ports": { "enabled": [1, 2, 3, 4] },
+ *       "vlans": {
+ *         "1":  { "name": "default", "ports": [1, 2, 3, 4] },
+ *         "10": { "name": "users", "ports": [3], "tagged": [4] }
+ *       },
+ *       "routes": [
+ *         { "prefix": "10.0.0.0/8", "next_hop": "192.168.1.1", "interface": 4, "metric": 1 }
+ *       ]
+ *     }
+ *   }
+ *
+ * "ports" of a VLAN are its untagged members, "tagged" its tagged ones.
+ * A prefix listed more than once has one path per entry. Unknown members
+ * are skipped.
+ *
+ * The text is parsed as a stream: every VLAN and route goes into the
+ * model when its object closes, so memory follows the size of the model
+ * rather than of the text, and a file is read in chunks. Objects are not
+ * applied as they are read because the diff needs the whole target; the
+ * apply itself is batched. A file may have a compiled copy next to it,
+ * the model as raw records behind a header that names the size, mtime
+ * and inode of the JSON file; it is used only while they still match.
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_MANAGEMENT_CONFIG_MODEL_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_MANAGEMENT_CONFIG_MODEL_H
+
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "l2/vlan.h"
+#include "l3/routing_table.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CONFIG_MODEL_NAME_LEN       64      /**< Longest switch name, with the terminator */
+#define CONFIG_MODEL_MAX_DEPTH      32      /**< Deepest JSON nesting accepted */
+
+/* One VLAN */
+typedef struct {
+    vlan_id_t vlan_id;
+    char name[VLAN_NAME_MAX_LEN];
+    vlan_port_bitmap_t untagged;    /* Untagged members */
+    vlan_port_bitmap_t tagged;      /* Tagged members, never also untagged */
+} config_vlan_t;
+
+/* Parsed configuration */
+typedef struct {
+    char name[CONFIG_MODEL_NAME_LEN];
+    vlan_port_bitmap_t enabled_ports;
+    config_vlan_t *vlans;           /* Sorted by VLAN ID */
+    uint32_t vlan_count;
+    routing_route_t *routes;        /* Static paths, sorted by prefix and path */
+    uint32_t route_count;
+} config_model_t;
+
+/* Changes made by an apply */
+typedef struct {
+    uint32_t ports_enabled;
+    uint32_t ports_disabled;
+    uint32_t vlans_created;
+    uint32_t vlans_deleted;
+    uint32_t vlans_renamed;
+    uint32_t members_added;
+    uint32_t members_removed;
+    uint32_t routes_added;          /* Paths */
+    uint32_t routes_removed;        /* Paths */
+    uint32_t failed;                /* Changes that failed */
+    uint64_t elapsed_us;
+} config_diff_stats_t;
+
+/* Empty model */
+void config_model_init(config_model_t *model);
+void config_model_free(config_model_t *model);
+status_t config_model_copy(config_model_t *dst, const config_model_t *src);
+
+/*
+ * Parse a JSON configuration; the model is replaced only on success.
+ * STATUS_INVALID_PARAMETER for malformed JSON or objects out of range.
+ */
+status_t config_model_parse(config_model_t *model, const char *json, size_t size);
+
+/* Incremental parser; text may be fed in pieces of any size */
+typedef struct config_stream config_stream_t;
+
+config_stream_t *config_stream_create(void);
+status_t config_stream_feed(config_stream_t *stream, const char *data, size_t size);
+/* Check the whole text and move the model out; the model is replaced only on success */
+status_t config_stream_finish(config_stream_t *stream, config_model_t *model);
+void config_stream_destroy(config_stream_t *stream);
+
+/*
+ * Read a JSON configuration file in chunks. With a cache path, a compiled
+ * copy still matching the file is read instead, and one is written after
+ * parsing; *cached tells which happened. STATUS_NOT_FOUND if there is no file.
+ */
+status_t config_model_load_file(config_model_t *model, const char *path, const char *cache_path, bool *cached);
+status_t config_model_write_cache(const config_model_t *model, const char *source_path, const char *cache_path);
+
+/* Write the model as JSON; *length excludes the terminator, STATUS_RESOURCE_EXCEEDED if it does not fit */
+status_t config_model_render(const config_model_t *model, char *buffer, size_t size, size_t *length);
+
+/*
+ * Change or read one parameter, named by its JSON path:
+ *   switch.name                    text
+ *   switch.ports.enabled           port list, "1,2,3"
+ *   switch.vlans.<id>              name, "" deletes the VLAN
+ *   switch.vlans.<id>.name         text, creates the VLAN if needed
+ *   switch.vlans.<id>.ports        port list
+ *   switch.vlans.<id>.tagged       port list
+ *   switch.routes.<prefix>/<len>   paths "next_hop[,interface[,metric]]" separated by ';', "" deletes
+ * STATUS_NOT_FOUND for an unknown key, STATUS_INVALID_PARAMETER for a bad value.
+ */
+status_t config_model_set(config_model_t *model, const char *key, const char *value);
+status_t config_model_get(const config_model_t *model, const char *key, char *value, size_t size);
+
+/*
+ * Make the switch go from running to target, changing only what differs.
+ * Every change is tried; creating what exists or removing what is gone
+ * counts as done, so an apply that failed can be retried.
+ * Returns the error of the last change that failed.
+ */
+status_t config_model_apply(const config_model_t *running, const config_model_t *target,
+                            config_diff_stats_t *stats);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_MANAGEMENT_CONFIG_MODEL_H */
@@ -0,0 +1,153 @@
+/**
+ * @file mgmt_server.h
+ * @brief HTTP management server for remote clients
+ *
+ * A REST server, HTTP/1.1 over TCP, for management clients outside the
+ * process such as the Python API. It runs on a thread of its own around
+ * one epoll descriptor and never touches the data path: requests go
+ * through the same management calls as the in-process API, and the
+ * thread can be pinned to a CPU the forwarding workers do not use.
+ *
+ * Connections are persistent unless the client asks otherwise, and
+ * requests may be pipelined: every complete request in a connection's
+ * buffer is answered in order, without waiting for the previous answer to
+ * be read. The work done per wakeup is bounded. A connection has at most
+ * CONFIG_MGMT_SERVER_REQUESTS_PER_EVENT requests handled before the other
+ * ready connections get their turn, at most MGMT_SERVER_READ_CHUNK bytes
+ * are read from it, and a client that does not read its answers stops
+ * being read once MGMT_SERVER_OUTPUT_LIMIT bytes wait for it.
+ *
+ * Endpoints:
+ *
+ *   GET    /v1/server            Server counters, JSON
+ *   GET    /v1/memory            Memory by subsystem, text (mem_account.h)
+ *   GET    /v1/config/<key>      Read a configuration parameter, text
+ *   PUT    /v1/config/<key>      Set it from the body, text
+ *   POST   /v1/config            Apply a JSON configuration, JSON diff counters
+ *   GET    /v1/routes            Every route, mgmt_route_record_t rows
+ *   POST   /v1/routes            Add the routes of the body
+ *   DELETE /v1/routes            Remove the routes of the body
+ *   GET    /v1/macs              The MAC table, mgmt_mac_record_t rows
+ *   POST   /v1/macs              Add the static entries of the body
+ *   DELETE /v1/macs              Delete the entries of the body
+ *   GET    /v1/vlan-members      Every membership, mgmt_vlan_member_record_t rows
+ *   POST   /v1/vlan-members      Add the memberships of the body
+ *   DELETE /v1/vlan-members      Remove the memberships of the body
+ *   POST   /v1/port-counters     Counters of the uint16_t port IDs of the body
+ *   POST   /v1/vlan-counters     Counters of the uint16_t VLAN IDs of the body
+ *
+ * The table endpoints are the batch calls of bulk_api.h: a body of packed
+ * rows, application/octet-stream, in host byte order, is one bulk call.
+ * Writes answer with an int32_t status per row; counter reads with the
+ * uint64_t matrix of bulk_read_port_counters(). An error is answered with
+ * an HTTP status for it and a JSON body {"status": <status_t>}.
+ */
+
+#ifndef SWITCH_SIM_MGMT_SERVER_H
+#define SWITCH_SIM_MGMT_SERVER_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../common/config.h"
+
+#define MGMT_SERVER_DEFAULT_PORT    8000
+#define MGMT_SERVER_MAX_HEADER      8192        /**< Request line and headers */
+#define MGMT_SERVER_READ_CHUNK      65536       /**< Bytes read from a connection per wakeup */
+#define MGMT_SERVER_OUTPUT_LIMIT    (1u << 20)  /**< Unread answer bytes that stop reading a connection */
+#define MGMT_SERVER_IDLE_TIMEOUT_S  300         /**< Idle connections are closed after this */
+
+/**
+ * @brief Route row, as bulk_route_columns_t
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t prefix[16];             /**< Network order; IPv4 in the first 4 bytes */
+    uint8_t next_hop[16];           /**< Zero for none */
+    uint8_t is_ipv6;
+    uint8_t prefix_len;
+    uint16_t interface;
+    uint16_t metric;
+    uint8_t source;                 /**< route_source_t */
+    uint8_t reserved;
+} mgmt_route_record_t;
+
+/**
+ * @brief MAC table row, as bulk_mac_columns_t
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t mac[6];
+    uint16_t vlan_id;
+    uint16_t port_id;
+    uint8_t type;                   /**< mac_entry_type_t, ignored on writes */
+    uint8_t reserved;
+    uint32_t age_timestamp;         /**< Ignored on writes */
+} mgmt_mac_record_t;
+
+/**
+ * @brief VLAN membership row, as bulk_vlan_member_columns_t
+ */
+typedef struct __attribute__((packed)) {
+    uint16_t vlan_id;
+    uint16_t port_id;
+    uint8_t tagged;
+    uint8_t reserved[3];
+} mgmt_vlan_member_record_t;
+
+_Static_assert(sizeof(mgmt_route_record_t) == 40, "route record layout");
+_Static_assert(sizeof(mgmt_mac_record_t) == 16, "MAC record layout");
+_Static_assert(sizeof(mgmt_vlan_member_record_t) == 8, "VLAN member record layout");
+
+/**
+ * @brief Server parameters
+ */
+typedef struct {
+    const char *address;            /**< IPv4 address to listen on, NULL for every address */
+    uint16_t port;                  /**< TCP port, 0 for MGMT_SERVER_DEFAULT_PORT */
+    int cpu;                        /**< CPU to pin the server thread to, -1 to leave it */
+} mgmt_server_config_t;
+
+/**
+ * @brief Server counters
+ */
+typedef struct {
+    uint64_t connections;           /**< Connections open */
+    uint64_t accepted;              /**< Connections accepted */
+    uint64_t rejected;              /**< Connections closed at once for want of a slot */
+    uint64_t idle_closed;           /**< Connections closed for being idle */
+    uint64_t requests;              /**< Requests answered */
+    uint64_t pipelined;             /**< Requests found behind another in the same read */
+    uint64_t deferred;              /**< Times a connection used up its requests per wakeup */
+    uint64_t throttled;             /**< Times a connection stopped being read for unread answers */
+    uint64_t errors;                /**< Requests answered with a 4xx or 5xx status */
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+} mgmt_server_stats_t;
+
+/**
+ * @brief Listen and start the server thread
+ *
+ * @param config Parameters, NULL for the defaults
+ * @return STATUS_SUCCESS on success, STATUS_ALREADY_INITIALIZED,
+ *         STATUS_INVALID_PARAMETER for an address that does not parse,
+ *         STATUS_NO_MEMORY, STATUS_FAILURE if the socket or the thread
+ *         cannot be set up
+ */
+status_t mgmt_server_start(const mgmt_server_config_t *config);
+
+/**
+ * @brief Stop the server thread and close every connection
+ *
+ * Answers not yet written are lost.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not started
+ */
+status_t mgmt_server_stop(void);
+
+/**
+ * @brief Get server counters
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t mgmt_server_get_stats(mgmt_server_stats_t *stats);
+
+#endif /* SWITCH_SIM_MGMT_SERVER_H */
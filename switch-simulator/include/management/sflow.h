@@ -0,0 +1,110 @@
+/**
+ * @file sflow.h
+ * @brief sFlow version 5 agent: random packet sampling and counter polling
+ *
+ * Each port with a sampling rate N has every forwarding thread take one
+ * frame in N at random. A thread keeps a countdown per port, drawn from
+ * its own generator when a sample is taken, so an unsampled frame costs
+ * a decrement and a predicted branch; the generator runs once per sample,
+ * not once per frame. Skips are uniform in [1, 2N - 1], which averages N
+ * and leaves no periodic pattern for traffic to alias with.
+ *
+ * A sampled frame's first CONFIG_SFLOW_HEADER_BYTES are copied into a
+ * lock-free ring of many producers and one consumer, the exporter thread.
+ * The exporter drains the ring every flush interval, packs the flow
+ * samples into as few datagrams as fit, and every counter interval adds
+ * a generic interface counter sample of each sampled port, read from the
+ * port statistics the data path keeps per thread. Datagrams (sFlow v5,
+ * XDR encoded) go over UDP to one collector.
+ *
+ * Sampling is an ingress pipeline stage; the sampled input interface is
+ * the ifIndex port_id + 1 and the output interface is left unknown.
+ */
+
+#ifndef SWITCH_SIM_SFLOW_H
+#define SWITCH_SIM_SFLOW_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../common/config.h"
+
+#define SFLOW_VERSION               5
+#define SFLOW_MAX_DATAGRAM          1400    /**< Largest datagram sent */
+#define SFLOW_PROCESSOR_PRIORITY    110     /**< Pipeline priority of the sampling stage */
+
+#define SFLOW_DEFAULT_FLUSH_MS              250
+#define SFLOW_DEFAULT_COUNTER_INTERVAL_S    20
+
+/**
+ * @brief Agent configuration
+ */
+typedef struct {
+    const char *host;               /**< Collector address or name */
+    uint16_t port;                  /**< Collector UDP port, 0 for 6343 */
+    uint32_t agent_address;         /**< IPv4 address of the agent, host order */
+    uint32_t sub_agent_id;          /**< Sub-agent, 0 if there is one */
+    uint32_t flush_interval_ms;     /**< Export cadence, 0 for SFLOW_DEFAULT_FLUSH_MS */
+    uint32_t counter_interval_s;    /**< Counter polling, 0 for SFLOW_DEFAULT_COUNTER_INTERVAL_S */
+} sflow_config_t;
+
+/**
+ * @brief Agent counters
+ */
+typedef struct {
+    uint64_t samples;               /**< Frames sampled */
+    uint64_t ring_drops;            /**< Samples lost to a full ring */
+    uint64_t flow_samples_sent;     /**< Flow samples exported */
+    uint64_t counter_samples_sent;  /**< Counter samples exported */
+    uint64_t datagrams_sent;
+    uint64_t send_errors;           /**< Datagrams the socket refused */
+} sflow_stats_t;
+
+/**
+ * @brief Start the agent: open the socket, start the exporter, register the stage
+ *
+ * Every port starts with sampling disabled.
+ *
+ * @param config Configuration, copied (host is not kept)
+ * @return STATUS_SUCCESS on success, STATUS_ALREADY_INITIALIZED,
+ *         STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY, or STATUS_FAILURE if
+ *         the collector cannot be resolved or the thread not started
+ */
+status_t sflow_init(const sflow_config_t *config);
+
+/**
+ * @brief Stop the agent; samples still queued are exported first
+ *
+ * Must not run concurrently with packet processing.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not started
+ */
+status_t sflow_shutdown(void);
+
+/**
+ * @brief Set the sampling rate of a port
+ *
+ * Threads pick up the new rate at their next burst.
+ *
+ * @param port_id Ingress port
+ * @param rate Sample 1 in rate frames, 0 to stop sampling and polling the port
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t sflow_set_port_rate(port_id_t port_id, uint32_t rate);
+
+/**
+ * @brief Get the sampling rate of a port
+ *
+ * @param port_id Port
+ * @return Rate, 0 if the port is not sampled
+ */
+uint32_t sflow_get_port_rate(port_id_t port_id);
+
+/**
+ * @brief Get the agent counters
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_INVALID_PARAMETER
+ */
+status_t sflow_get_stats(sflow_stats_t *stats);
+
+#endif /* SWITCH_SIM_SFLOW_H */
@@ -16,12 +16,17 @@
 #include "../common/types.h"
 #include "../hal/port.h"                // -> if port_stats.h solve problem, comment this line
 #include "../common/port_stats.h"
+#include "telemetry.h"
+#include "stats_threshold.h"
+#include "stats_history.h"
 
 typedef struct {
     uint64_t rx_packets;        /**< Received packets for this VLAN */
     uint64_t tx_packets;        /**< Transmitted packets for this VLAN */
     uint64_t rx_bytes;          /**< Received bytes for this VLAN */
     uint64_t tx_bytes;          /**< Transmitted bytes for this VLAN */
+    uint64_t storm_dropped_packets; /**< Flooded frames dropped by storm control */
+    uint64_t storm_dropped_bytes;   /**< Bytes of frames dropped by storm control */
     time_t last_clear;          /**< Timestamp of last counter clear */
 } vlan_stats_t;
 
@@ -61,8 +66,117 @@ status_t stats_clear_all(stats_context_t *ctx);
 status_t stats_enable_periodic_collection(stats_context_t *ctx, uint32_t interval_ms);
 status_t stats_disable_periodic_collection(stats_context_t *ctx);
 
+/**
+ * @brief Publish all counters in a shared-memory segment
+ *
+ * The segment is refreshed on every round of periodic collection; see
+ * stats_export.h for its layout. Enabling again replaces the segment.
+ *
+ * @param ctx Statistics context
+ * @param name Segment name as for shm_open(), NULL for the default
+ * @return status_t Status code
+ */
+status_t stats_enable_shm_export(stats_context_t *ctx, const char *name);
+
+/**
+ * @brief Stop publishing and remove the shared-memory segment
+ *
+ * @param ctx Statistics context
+ * @return status_t Status code
+ */
+status_t stats_disable_shm_export(stats_context_t *ctx);
+
+/**
+ * @brief Push changed counters to a collector over UDP
+ *
+ * A dedicated thread sends the counters of the subscribed object types
+ * every config->interval_ms, independently of periodic collection; see
+ * telemetry.h for the wire format. Enabling again replaces the exporter.
+ *
+ * @param ctx Statistics context
+ * @param config Collector, cadence and subscriptions
+ * @return status_t Status code
+ */
+status_t stats_enable_telemetry(stats_context_t *ctx, const telemetry_config_t *config);
+
+/**
+ * @brief Stop streaming telemetry
+ *
+ * @param ctx Statistics context
+ * @return status_t Status code
+ */
+status_t stats_disable_telemetry(stats_context_t *ctx);
+
+/**
+ * @brief Keep a time series of counters, with their rates
+ *
+ * A dedicated thread samples the counters of the chosen object types
+ * every config->interval_ms into fixed-size rings, in shared memory if
+ * config->name is set; see stats_history.h for the layout. Enabling
+ * again replaces the history.
+ *
+ * @param ctx Statistics context
+ * @param config Cadence, depth, object types and segment name
+ * @return status_t Status code
+ */
+status_t stats_enable_history(stats_context_t *ctx, const stats_history_config_t *config);
+
+/**
+ * @brief Stop sampling and drop the history
+ *
+ * @param ctx Statistics context
+ * @return status_t Status code
+ */
+status_t stats_disable_history(stats_context_t *ctx);
+
+/**
+ * @brief Current load of a port, from the rates of the last sample
+ *
+ * @param ctx Statistics context
+ * @param port_id Port
+ * @param[out] util Rates and percent of the port speed
+ * @return status_t Status code, STATUS_NOT_INITIALIZED without a history of ports
+ */
+status_t stats_get_port_utilization(stats_context_t *ctx, port_id_t port_id,
+                                    stats_history_utilization_t *util);
+
+/**
+ * @brief Samples of one counter, oldest first, see stats_history_get_series()
+ *
+ * @return status_t Status code, STATUS_NOT_INITIALIZED without a history
+ */
+status_t stats_get_counter_history(stats_context_t *ctx, telemetry_object_t obj, uint32_t index,
+                                   uint32_t counter, uint64_t *values, uint64_t *times_ns,
+                                   uint32_t max, uint32_t *count);
+
 status_t stats_register_counter(const char *counter_name, uint64_t *counter_ptr);
 
+/**
+ * @brief Watch one counter, or its rate per second, against a limit
+ *
+ * The callback runs on a dispatcher thread each time the value or rate
+ * rises above the limit; it fires again only after dropping back to or
+ * under it. Thresholds are checked every periodic collection interval.
+ *
+ * @param ctx Statistics context
+ * @param threshold Counter, limit and callback, copied
+ * @param[out] id Handle for stats_remove_threshold(), may be NULL
+ * @return status_t Status code
+ */
+status_t stats_add_threshold(stats_context_t *ctx, const stats_threshold_t *threshold, uint32_t *id);
+
+/**
+ * @brief Stop watching a threshold
+ *
+ * @param ctx Statistics context
+ * @param id Handle from stats_add_threshold()
+ * @return status_t Status code
+ */
+status_t stats_remove_threshold(stats_context_t *ctx, uint32_t id);
+
+/**
+ * @brief Watch a counter given by name, see stats_threshold_parse()
+ */
 status_t stats_register_threshold_callback(stats_context_t *ctx, 
                                               const char *stat_type,
                                               uint64_t threshold,
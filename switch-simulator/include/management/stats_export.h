@@ -0,0 +1,233 @@
+/**
+ * @file stats_export.h
+ * @brief Shared-memory statistics segment for external readers
+ *
+ * The statistics module can publish its port, VLAN, queue and routing
+ * counters in a POSIX shared-memory segment (shm_open(), so on Linux the
+ * file /dev/shm/<name>). Readers map it read-only and copy counters out
+ * without calling into the simulator; the data path never touches the
+ * segment, it is only written by the statistics collection thread.
+ *
+ * Layout, all little-endian as on the host, offsets from the start of
+ * the segment:
+ *
+ *   0                stats_export_header_t
+ *   port_offset      port_count records of port_record_size bytes
+ *   vlan_offset      vlan_count records, indexed by VLAN ID
+ *   queue_offset     port_count * queues_per_port records, index
+ *                    port * queues_per_port + queue
+ *   routing_offset   one routing record
+ *
+ * Records are arrays of uint64_t as described by the structs below.
+ * Readers must step through records by the record sizes in the header:
+ * minor versions only append fields to records, so a reader built
+ * against an older layout keeps working. A different major version
+ * changes the meaning of existing fields and must be refused.
+ *
+ * Consistency is guarded by a sequence lock. The writer makes sequence
+ * odd, updates the records, and makes it even again. A reader loads
+ * sequence (acquire), retries while it is odd, copies what it needs,
+ * then loads sequence again after an acquire fence and retries if it
+ * changed. stats_export_read() implements this for C readers.
+ */
+
+#ifndef STATS_EXPORT_H
+#define STATS_EXPORT_H
+
+#include <stddef.h>
+#include <string.h>
+#include <sched.h>
+#include "../common/types.h"
+#include "../common/error_codes.h"
+
+/** "SWST" read as a little-endian uint32_t */
+#define STATS_EXPORT_MAGIC          0x54535753u
+#define STATS_EXPORT_VERSION_MAJOR  1
+#define STATS_EXPORT_VERSION_MINOR  0
+
+/** Segment name used when none is given */
+#define STATS_EXPORT_DEFAULT_NAME   "/switch_sim_stats"
+
+/**
+ * @brief Segment header, at offset 0
+ */
+typedef struct {
+    uint32_t magic;             /**< STATS_EXPORT_MAGIC */
+    uint16_t version_major;     /**< STATS_EXPORT_VERSION_MAJOR */
+    uint16_t version_minor;     /**< STATS_EXPORT_VERSION_MINOR */
+    uint32_t header_size;       /**< sizeof(stats_export_header_t) */
+    uint32_t writer_pid;        /**< Process that publishes the segment */
+    uint64_t total_size;        /**< Size of the segment in bytes */
+    uint64_t sequence;          /**< Sequence lock, odd while an update is in progress */
+    uint64_t update_time_ns;    /**< CLOCK_REALTIME of the last update */
+    uint64_t update_count;      /**< Completed updates */
+    uint32_t port_count;        /**< Port records */
+    uint32_t vlan_count;        /**< VLAN records */
+    uint32_t queues_per_port;   /**< Queue records per port */
+    uint32_t reserved;
+    uint32_t port_offset;
+    uint32_t port_record_size;
+    uint32_t vlan_offset;
+    uint32_t vlan_record_size;
+    uint32_t queue_offset;
+    uint32_t queue_record_size;
+    uint32_t routing_offset;
+    uint32_t routing_record_size;
+} stats_export_header_t;
+
+/**
+ * @brief Port record
+ */
+typedef struct {
+    uint64_t rx_packets;
+    uint64_t tx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t rx_errors;
+    uint64_t tx_errors;
+    uint64_t rx_drops;
+    uint64_t tx_drops;
+    uint64_t rx_unicast;
+    uint64_t tx_unicast;
+    uint64_t rx_broadcast;
+    uint64_t tx_broadcast;
+    uint64_t rx_multicast;
+    uint64_t tx_multicast;
+    uint64_t collisions;
+    uint64_t last_clear;        /**< Seconds since the epoch */
+} stats_export_port_t;
+
+/**
+ * @brief VLAN record
+ */
+typedef struct {
+    uint64_t rx_packets;
+    uint64_t tx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+    uint64_t storm_dropped_packets;
+    uint64_t storm_dropped_bytes;
+    uint64_t last_clear;        /**< Seconds since the epoch */
+} stats_export_vlan_t;
+
+/**
+ * @brief Egress queue record
+ */
+typedef struct {
+    uint64_t enqueued;
+    uint64_t dequeued;
+    uint64_t dropped;
+    uint64_t current_depth;
+    uint64_t max_depth;
+    uint64_t last_clear;        /**< Seconds since the epoch */
+} stats_export_queue_t;
+
+/**
+ * @brief Routing record
+ */
+typedef struct {
+    uint64_t routed_packets;
+    uint64_t routed_bytes;
+    uint64_t routing_failures;
+    uint64_t arp_requests;
+    uint64_t arp_replies;
+    uint64_t last_clear;        /**< Seconds since the epoch */
+} stats_export_routing_t;
+
+/**
+ * @brief INT hop record, of the hop in one sink slot
+ *
+ * Streamed and sampled as TELEMETRY_OBJ_INT, not kept in the segment.
+ */
+typedef struct {
+    uint64_t switch_id;
+    uint64_t egress_port;
+    uint64_t packets;
+    uint64_t latency_total_ns;
+    uint64_t latency_max_ns;
+    uint64_t depth_total;
+    uint64_t depth_max;
+} stats_export_int_t;
+
+/**
+ * @brief Writer side of a segment; private to stats_export.c
+ */
+typedef struct stats_export stats_export_t;
+
+/**
+ * @brief Create and map a segment
+ *
+ * An existing segment of the same name is replaced. The records start
+ * out zero and the segment is published once stats_export_publish() is
+ * first called.
+ *
+ * @param name Segment name as for shm_open(), NULL for STATS_EXPORT_DEFAULT_NAME
+ * @param port_count Port records
+ * @param vlan_count VLAN records
+ * @param queues_per_port Queue records per port
+ * @param[out] exp New segment
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY, or
+ *         STATUS_FAILURE if the segment could not be created
+ */
+status_t stats_export_create(const char *name, uint32_t port_count, uint32_t vlan_count,
+                             uint32_t queues_per_port, stats_export_t **exp);
+
+/**
+ * @brief Unmap and unlink a segment
+ *
+ * @param exp Segment, may be NULL
+ */
+void stats_export_destroy(stats_export_t *exp);
+
+/**
+ * @brief Records of the next update
+ *
+ * The writer fills these staging copies at its own pace; readers see
+ * none of it until stats_export_publish().
+ *
+ * @param exp Segment
+ * @param index Port, VLAN ID, or port * queues_per_port + queue
+ * @return Record, NULL if index is out of range
+ */
+stats_export_port_t *stats_export_port(stats_export_t *exp, uint32_t index);
+stats_export_vlan_t *stats_export_vlan(stats_export_t *exp, uint32_t index);
+stats_export_queue_t *stats_export_queue(stats_export_t *exp, uint32_t index);
+stats_export_routing_t *stats_export_routing(stats_export_t *exp);
+
+/**
+ * @brief Copy the staged records into the segment under the sequence lock
+ *
+ * Only one thread may publish a segment.
+ *
+ * @param exp Segment
+ */
+void stats_export_publish(stats_export_t *exp);
+
+/**
+ * @brief Copy a consistent range out of a mapped segment
+ *
+ * @param hdr Mapped segment
+ * @param offset Offset of the range in the segment
+ * @param size Bytes to copy
+ * @param[out] dst Destination
+ * @return true once a copy was taken that no update overlapped; false if
+ *         the range is outside the segment
+ */
+static inline bool stats_export_read(const stats_export_header_t *hdr, size_t offset,
+                                     size_t size, void *dst) {
+    uint64_t begin;
+
+    if (offset > hdr->total_size || size > hdr->total_size - offset) {
+        return false;
+    }
+    do {
+        while ((begin = __atomic_load_n(&hdr->sequence, __ATOMIC_ACQUIRE)) & 1) {
+            sched_yield();
+        }
+        memcpy(dst, (const char *)hdr + offset, size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&hdr->sequence, __ATOMIC_RELAXED) != begin);
+    return true;
+}
+
+#endif /* STATS_EXPORT_H */
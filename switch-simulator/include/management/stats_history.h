@@ -0,0 +1,292 @@
+/**
+ * @file stats_history.h
+ * @brief Counter time series with rates, in shared memory
+ *
+ * The statistics module can sample the counters of the chosen object
+ * types at a fixed cadence and keep the last depth samples of every
+ * counter in a ring, together with its rate per second over the last
+ * interval, an exponentially weighted moving average of that rate and
+ * the highest rate seen. Rates are computed once per sample by the
+ * writer, so asking for the utilization of a port is a lookup.
+ *
+ * The history lives in a POSIX shared-memory segment when it is given a
+ * name (on Linux the file /dev/shm/<name>), otherwise in private memory.
+ * In-process queries and external readers see the same layout, all
+ * little-endian as on the host, offsets from the start of the segment:
+ *
+ *   0                    stats_history_header_t
+ *   time_offset          slots uint64_t, CLOCK_REALTIME ns of each slot
+ *   speed_offset         count[PORT] uint64_t, port speed in Mbps, 0 if unknown
+ *   sample_offset[type]  count[type] * slots records of words[type]
+ *                        uint64_t; the record of object i in slot s is
+ *                        number i * slots + s
+ *   rate_offset[type]    count[type] * words[type] stats_history_rate_t,
+ *                        the rates of counter c of object i at number
+ *                        i * words[type] + c
+ *
+ * Types are telemetry_object_t and records are the stats_export_*_t
+ * records, counters numbered as their fields. Types that are not
+ * sampled have a count of 0.
+ *
+ * The ring has one slot more than the samples it shows: the newest
+ * sample is in slot head, the one before it in slot head - 1, and so on
+ * for samples slots, wrapping around. The writer fills the spare slot
+ * while it gathers and makes it visible under the sequence lock, which
+ * works as in stats_export.h; stats_history_read() implements it.
+ *
+ * Rates are per second. A counter that went down, as after a clear,
+ * reports a rate of 0 for that interval. Objects missing from a round,
+ * such as deleted VLANs, repeat their previous sample.
+ */
+
+#ifndef STATS_HISTORY_H
+#define STATS_HISTORY_H
+
+#include <stddef.h>
+#include <string.h>
+#include <sched.h>
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "telemetry.h"
+
+/** "SWHS" read as a little-endian uint32_t */
+#define STATS_HISTORY_MAGIC             0x53485753u
+#define STATS_HISTORY_VERSION_MAJOR     2
+#define STATS_HISTORY_VERSION_MINOR     0
+
+/** Segment name used by the simulator's -H option when none is given */
+#define STATS_HISTORY_DEFAULT_NAME      "/switch_sim_history"
+
+/** Samples kept when the configuration leaves depth at 0 */
+#define STATS_HISTORY_DEFAULT_DEPTH     300
+
+/** Weight of a new rate in the average when the configuration leaves it at 0 */
+#define STATS_HISTORY_DEFAULT_EWMA_PCT  20
+
+/**
+ * @brief History configuration
+ */
+typedef struct {
+    const char *name;           /**< Segment name as for shm_open(), NULL for private memory */
+    uint32_t interval_ms;       /**< Sampling cadence */
+    uint32_t depth;             /**< Samples kept per counter, 0 for the default */
+    uint32_t objects;           /**< TELEMETRY_SUBSCRIBE() bits of the types to sample */
+    uint8_t ewma_pct;           /**< Weight of a new rate in percent, 1 to 100, 0 for the default */
+} stats_history_config_t;
+
+/**
+ * @brief Segment header, at offset 0
+ */
+typedef struct {
+    uint32_t magic;             /**< STATS_HISTORY_MAGIC */
+    uint16_t version_major;     /**< STATS_HISTORY_VERSION_MAJOR */
+    uint16_t version_minor;     /**< STATS_HISTORY_VERSION_MINOR */
+    uint32_t header_size;       /**< sizeof(stats_history_header_t) */
+    uint32_t writer_pid;        /**< Process that writes the history */
+    uint64_t total_size;        /**< Size of the segment in bytes */
+    uint64_t sequence;          /**< Sequence lock, odd while a sample is published */
+    uint64_t update_time_ns;    /**< CLOCK_REALTIME of the newest sample */
+    uint64_t update_count;      /**< Samples taken */
+    uint32_t interval_ms;       /**< Sampling cadence */
+    uint32_t depth;             /**< Most samples shown */
+    uint32_t slots;             /**< Slots of the ring, depth + 1 */
+    uint32_t head;              /**< Slot of the newest sample */
+    uint32_t samples;           /**< Samples shown, up to depth */
+    uint32_t ewma_pct;          /**< Weight of a new rate in the average */
+    uint32_t time_offset;
+    uint32_t speed_offset;
+    uint32_t count[TELEMETRY_OBJ_COUNT];         /**< Objects of each type */
+    uint32_t words[TELEMETRY_OBJ_COUNT];         /**< Counters per record of each type */
+    uint32_t sample_offset[TELEMETRY_OBJ_COUNT];
+    uint32_t rate_offset[TELEMETRY_OBJ_COUNT];
+} stats_history_header_t;
+
+/**
+ * @brief Rates of one counter, per second
+ */
+typedef struct {
+    double rate;                /**< Over the last interval */
+    double ewma;                /**< Moving average of rate */
+    double peak;                /**< Highest rate since the history started */
+} stats_history_rate_t;
+
+/**
+ * @brief Load of one port from its byte rates and speed
+ */
+typedef struct {
+    double rx_bps;              /**< Received bits per second, last interval */
+    double tx_bps;
+    double rx_avg_bps;          /**< Moving averages */
+    double tx_avg_bps;
+    double rx_peak_bps;
+    double tx_peak_bps;
+    double rx_percent;          /**< rx_bps of the port speed, 0 if the speed is unknown */
+    double tx_percent;
+    uint64_t speed_mbps;        /**< Port speed, 0 if unknown */
+} stats_history_utilization_t;
+
+/**
+ * @brief Writer side of a history; private to stats_history.c
+ */
+typedef struct stats_history stats_history_t;
+
+/**
+ * @brief Create a history
+ *
+ * An existing segment of the same name is replaced.
+ *
+ * @param config Configuration; interval_ms is only recorded, the caller samples
+ * @param counts Objects of each type, by telemetry_object_t
+ * @param words Counters per record of each type
+ * @param[out] hist New history
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY, or
+ *         STATUS_FAILURE if the segment could not be created
+ */
+status_t stats_history_create(const stats_history_config_t *config,
+                              const uint32_t counts[TELEMETRY_OBJ_COUNT],
+                              const uint32_t words[TELEMETRY_OBJ_COUNT],
+                              stats_history_t **hist);
+
+/**
+ * @brief Unmap the history, unlinking its segment
+ *
+ * @param hist History, may be NULL
+ */
+void stats_history_destroy(stats_history_t *hist);
+
+/**
+ * @brief Object types the history samples, as TELEMETRY_SUBSCRIBE() bits
+ */
+uint32_t stats_history_objects(const stats_history_t *hist);
+
+/**
+ * @brief Start taking a sample
+ *
+ * Only one thread may write a history.
+ */
+void stats_history_begin(stats_history_t *hist);
+
+/**
+ * @brief Store the counters of one object in the sample being taken
+ *
+ * Matches the record sinks of the statistics module; arg is the history.
+ */
+void stats_history_record(void *arg, telemetry_object_t obj, uint32_t index,
+                          const uint64_t *counters);
+
+/**
+ * @brief Store the speed of a port in the sample being taken
+ *
+ * @param hist History
+ * @param port Port
+ * @param speed_mbps Speed in Mbps, 0 if unknown
+ */
+void stats_history_set_port_speed(stats_history_t *hist, uint32_t port, uint64_t speed_mbps);
+
+/**
+ * @brief Compute the rates and make the sample visible
+ */
+void stats_history_end(stats_history_t *hist);
+
+/**
+ * @brief The segment, for readers
+ */
+const stats_history_header_t *stats_history_header(const stats_history_t *hist);
+
+/**
+ * @brief Rates of one counter
+ *
+ * @param hdr Mapped history
+ * @param obj Object type
+ * @param index Object index
+ * @param counter Counter number in the record
+ * @param[out] rate Rates
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER if the type is not
+ *         sampled or index or counter is out of range
+ */
+status_t stats_history_get_rate(const stats_history_header_t *hdr, telemetry_object_t obj,
+                                uint32_t index, uint32_t counter, stats_history_rate_t *rate);
+
+/**
+ * @brief Rates of every counter of one object
+ *
+ * @param hdr Mapped history
+ * @param obj Object type
+ * @param index Object index
+ * @param[out] rates words[obj] entries
+ * @param max Entries rates has room for
+ * @param[out] count Entries written
+ * @return STATUS_SUCCESS or STATUS_INVALID_PARAMETER
+ */
+status_t stats_history_get_rates(const stats_history_header_t *hdr, telemetry_object_t obj,
+                                 uint32_t index, stats_history_rate_t *rates, uint32_t max,
+                                 uint32_t *count);
+
+/**
+ * @brief Samples of one counter, oldest first
+ *
+ * @param hdr Mapped history
+ * @param obj Object type
+ * @param index Object index
+ * @param counter Counter number in the record
+ * @param[out] values Counter values
+ * @param[out] times_ns CLOCK_REALTIME of each value, may be NULL
+ * @param max Newest samples to return
+ * @param[out] count Samples written
+ * @return STATUS_SUCCESS or STATUS_INVALID_PARAMETER
+ */
+status_t stats_history_get_series(const stats_history_header_t *hdr, telemetry_object_t obj,
+                                  uint32_t index, uint32_t counter, uint64_t *values,
+                                  uint64_t *times_ns, uint32_t max, uint32_t *count);
+
+/**
+ * @brief Load of one port
+ *
+ * @param hdr Mapped history
+ * @param port Port
+ * @param[out] util Rates in bits per second and percent of the port speed
+ * @return STATUS_SUCCESS or STATUS_INVALID_PARAMETER if ports are not sampled
+ */
+status_t stats_history_port_utilization(const stats_history_header_t *hdr, uint32_t port,
+                                        stats_history_utilization_t *util);
+
+/**
+ * @brief Copy a consistent range out of a mapped history
+ *
+ * @param hdr Mapped history
+ * @param offset Offset of the range in the segment
+ * @param size Bytes to copy
+ * @param[out] dst Destination
+ * @param[out] head Slot of the newest sample the copy belongs to, may be NULL
+ * @param[out] samples Samples shown with it, may be NULL
+ * @return true once a copy was taken that no sample overlapped; false if
+ *         the range is outside the segment
+ */
+static inline bool stats_history_read(const stats_history_header_t *hdr, size_t offset,
+                                      size_t size, void *dst, uint32_t *head, uint32_t *samples) {
+    uint64_t begin;
+    uint32_t h, n;
+
+    if (offset > hdr->total_size || size > hdr->total_size - offset) {
+        return false;
+    }
+    do {
+        while ((begin = __atomic_load_n(&hdr->sequence, __ATOMIC_ACQUIRE)) & 1) {
+            sched_yield();
+        }
+        h = hdr->head;
+        n = hdr->samples;
+        memcpy(dst, (const char *)hdr + offset, size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&hdr->sequence, __ATOMIC_RELAXED) != begin);
+
+    if (head) {
+        *head = h;
+    }
+    if (samples) {
+        *samples = n;
+    }
+    return true;
+}
+
+#endif /* STATS_HISTORY_H */
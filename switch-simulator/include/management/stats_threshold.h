@@ -0,0 +1,136 @@
+/**
+ * @file stats_threshold.h
+ * @brief Threshold monitoring over the statistics counters
+ *
+ * A threshold watches one counter of one object, either its value or its
+ * rate of change per second. Registration resolves it to a slot in a
+ * flat counter snapshot, so evaluation is a pass over plain arrays with
+ * no string handling. Callbacks fire when a threshold is crossed upwards,
+ * not on every interval it stays exceeded, and run on a dispatcher
+ * thread so a slow callback never delays collection.
+ */
+
+#ifndef STATS_THRESHOLD_H
+#define STATS_THRESHOLD_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "telemetry.h"
+
+/** Callback events queued for the dispatcher before new ones are dropped */
+#define STATS_THRESHOLD_EVENT_QUEUE 1024
+
+/**
+ * @brief What a threshold compares
+ */
+typedef enum {
+    STATS_THRESHOLD_VALUE = 0,  /**< Counter value */
+    STATS_THRESHOLD_RATE        /**< Increase per second since the last interval */
+} stats_threshold_kind_t;
+
+/**
+ * @brief Threshold definition
+ */
+typedef struct {
+    telemetry_object_t object;  /**< Object type */
+    uint32_t index;             /**< Port, VLAN ID, port * queues + queue, INT hop slot, or 0 */
+    uint32_t counter;           /**< Field number in the stats_export_*_t record */
+    stats_threshold_kind_t kind;
+    uint64_t threshold;         /**< Exceeded when the value or rate is above it */
+    void (*callback)(void *user_data);
+    void *user_data;
+} stats_threshold_t;
+
+/**
+ * @brief Threshold engine; private to stats_threshold.c
+ */
+typedef struct stats_threshold_engine stats_threshold_engine_t;
+
+/**
+ * @brief Create an engine and its dispatcher thread
+ *
+ * @param counts Objects of each type, by telemetry_object_t
+ * @param words Counters per record of each type
+ * @param[out] engine New engine
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY or STATUS_FAILURE
+ */
+status_t stats_threshold_engine_create(const uint32_t counts[TELEMETRY_OBJ_COUNT],
+                                       const uint32_t words[TELEMETRY_OBJ_COUNT],
+                                       stats_threshold_engine_t **engine);
+
+/**
+ * @brief Stop the dispatcher, dropping queued events, and free an engine
+ *
+ * @param engine Engine, may be NULL
+ */
+void stats_threshold_engine_destroy(stats_threshold_engine_t *engine);
+
+/**
+ * @brief Add a threshold
+ *
+ * @param engine Engine
+ * @param threshold Definition, copied
+ * @param[out] id Handle for stats_threshold_remove(), may be NULL
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER or STATUS_NO_MEMORY
+ */
+status_t stats_threshold_add(stats_threshold_engine_t *engine, const stats_threshold_t *threshold,
+                             uint32_t *id);
+
+/**
+ * @brief Remove a threshold
+ *
+ * Events it queued before removal may still be delivered.
+ *
+ * @param engine Engine
+ * @param id Handle from stats_threshold_add()
+ * @return STATUS_SUCCESS or STATUS_NOT_FOUND
+ */
+status_t stats_threshold_remove(stats_threshold_engine_t *engine, uint32_t id);
+
+/**
+ * @brief Resolve a counter name of the form <object>_<counter>_<index>
+ *
+ * For example "port_rx_packets_1", "vlan_tx_bytes_100", "queue_dropped_3_7"
+ * (port 3, queue 7), "int_depth_max_0" (INT hop slot 0) or
+ * "routing_arp_requests". Counter names are the field names of the
+ * stats_export_*_t records.
+ *
+ * @param name Counter name
+ * @param queues_per_port Queues per port, for queue names
+ * @param[out] threshold object, index and counter are filled in
+ * @return STATUS_SUCCESS or STATUS_INVALID_PARAMETER
+ */
+status_t stats_threshold_parse(const char *name, uint32_t queues_per_port,
+                               stats_threshold_t *threshold);
+
+/**
+ * @brief Object types some threshold watches, as TELEMETRY_SUBSCRIBE() bits
+ */
+uint32_t stats_threshold_objects(stats_threshold_engine_t *engine);
+
+/**
+ * @brief Start filling the snapshot of a new interval
+ */
+void stats_threshold_begin(stats_threshold_engine_t *engine);
+
+/**
+ * @brief Store the counters of one object in the snapshot
+ *
+ * Matches the record sinks of the statistics module; arg is the engine.
+ */
+void stats_threshold_record(void *arg, telemetry_object_t obj, uint32_t index,
+                            const uint64_t *counters);
+
+/**
+ * @brief Compare the snapshot with every threshold and queue callbacks
+ *
+ * @return Number of thresholds that crossed, including any whose event was dropped
+ */
+uint32_t stats_threshold_evaluate(stats_threshold_engine_t *engine);
+
+/**
+ * @brief Callback events dropped because the dispatcher fell behind
+ */
+uint64_t stats_threshold_dropped_events(stats_threshold_engine_t *engine);
+
+#endif /* STATS_THRESHOLD_H */
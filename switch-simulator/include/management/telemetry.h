@@ -0,0 +1,144 @@
+/**
+ * @file telemetry.h
+ * @brief Streaming telemetry: push changed counters over UDP
+ *
+ * Every interval the statistics module hands the current counters of
+ * each subscribed object to the exporter, which sends only the ones that
+ * changed since the previous interval as varint-encoded deltas. Every
+ * keyframe_every intervals all subscribed objects are sent with absolute
+ * values instead, so a receiver that lost datagrams resynchronizes.
+ *
+ * Datagram format, integers little-endian:
+ *
+ *   u32 magic        TELEMETRY_MAGIC
+ *   u8  version      TELEMETRY_VERSION
+ *   u8  flags        TELEMETRY_FLAG_*
+ *   u16 reserved
+ *   u32 sequence     Datagram counter, gaps mean loss
+ *   u32 interval     Interval counter, shared by its datagrams
+ *   u64 time_ns      CLOCK_REALTIME when the interval was taken
+ *
+ * followed by records until the end of the datagram:
+ *
+ *   u8     object    telemetry_object_t
+ *   varint index     Port, VLAN ID, port * queues + queue, INT hop slot, or 0
+ *   varint mask      Bit n set: counter n of the record follows
+ *   varint value...  One per set bit, in counter order
+ *
+ * Counters are numbered as the fields of the stats_export_*_t records in
+ * stats_export.h. Varints are LEB128. In a keyframe a value is the
+ * counter itself; otherwise it is the zigzag-encoded signed difference
+ * to the previous interval (negative after a clear). A keyframe lists
+ * every active object, so a receiver can forget objects missing from it.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+
+/** "SWTM" read as a little-endian uint32_t */
+#define TELEMETRY_MAGIC             0x4d545753u
+#define TELEMETRY_VERSION           1
+#define TELEMETRY_HEADER_SIZE       24
+
+/** Records carry absolute values */
+#define TELEMETRY_FLAG_KEYFRAME     0x01
+/** Last datagram of its interval */
+#define TELEMETRY_FLAG_END          0x02
+
+/** Largest datagram sent, to stay under a typical path MTU */
+#define TELEMETRY_MAX_DATAGRAM      1400
+
+/** Counters a record may have */
+#define TELEMETRY_MAX_COUNTERS      32
+
+/**
+ * @brief Object types, also the bit numbers of subscription filters
+ */
+typedef enum {
+    TELEMETRY_OBJ_PORT = 0,
+    TELEMETRY_OBJ_VLAN,
+    TELEMETRY_OBJ_QUEUE,
+    TELEMETRY_OBJ_ROUTING,
+    TELEMETRY_OBJ_INT,          /**< Hops seen by the INT sink ports, see hal/int_telemetry.h */
+    TELEMETRY_OBJ_COUNT
+} telemetry_object_t;
+
+#define TELEMETRY_SUBSCRIBE(obj)    (1u << (obj))
+#define TELEMETRY_SUBSCRIBE_ALL     ((1u << TELEMETRY_OBJ_COUNT) - 1)
+
+/**
+ * @brief Exporter configuration
+ */
+typedef struct {
+    const char *host;           /**< Collector address or name */
+    uint16_t port;              /**< Collector UDP port */
+    uint32_t interval_ms;       /**< Push cadence */
+    uint32_t subscriptions;     /**< TELEMETRY_SUBSCRIBE() bits */
+    uint32_t keyframe_every;    /**< Intervals between keyframes, 0 for only the first */
+} telemetry_config_t;
+
+/**
+ * @brief Exporter; private to telemetry.c
+ */
+typedef struct telemetry telemetry_t;
+
+/**
+ * @brief Create an exporter
+ *
+ * @param config Configuration, copied
+ * @param counts Objects of each type (index range), by telemetry_object_t
+ * @param words Counters per record of each type, at most TELEMETRY_MAX_COUNTERS
+ * @param[out] tel New exporter
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY, or
+ *         STATUS_FAILURE if the collector cannot be resolved or reached
+ */
+status_t telemetry_create(const telemetry_config_t *config,
+                          const uint32_t counts[TELEMETRY_OBJ_COUNT],
+                          const uint32_t words[TELEMETRY_OBJ_COUNT],
+                          telemetry_t **tel);
+
+/**
+ * @brief Close the socket and free an exporter
+ *
+ * @param tel Exporter, may be NULL
+ */
+void telemetry_destroy(telemetry_t *tel);
+
+/**
+ * @brief Whether an object type is subscribed
+ */
+bool telemetry_subscribed(const telemetry_t *tel, telemetry_object_t obj);
+
+/**
+ * @brief Start an interval
+ */
+void telemetry_begin(telemetry_t *tel);
+
+/**
+ * @brief Report the current counters of one object
+ *
+ * Objects of unsubscribed types and unchanged objects outside keyframes
+ * cost a comparison and produce no output.
+ *
+ * @param tel Exporter
+ * @param obj Object type
+ * @param index Object index, below the count given at creation
+ * @param counters Counters, as many as given at creation for the type
+ */
+void telemetry_record(telemetry_t *tel, telemetry_object_t obj, uint32_t index,
+                      const uint64_t *counters);
+
+/**
+ * @brief Finish an interval and send what is left
+ */
+void telemetry_end(telemetry_t *tel);
+
+/**
+ * @brief Push cadence of the exporter
+ */
+uint32_t telemetry_interval_ms(const telemetry_t *tel);
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,136 @@
+/**
+ * @file warm_restart.h
+ * @brief Warm restart: forwarding state kept across simulator restarts
+ *
+ * A checkpoint holds the routes of the default VRF, the resolved ARP
+ * entries and the learned MAC entries. It is written on shutdown and,
+ * optionally, periodically; the next start maps it and restores the
+ * tables before the protocols run, so traffic keeps flowing while they
+ * reconverge.
+ *
+ * Restored routes are stale. A protocol or the configuration adding the
+ * same path again refreshes a route; the routes still stale when the hold
+ * timer expires are swept. Restored ARP and MAC entries are dynamic and
+ * age out as usual unless traffic refreshes them.
+ *
+ * The checkpoint is an image of the simulator's own structures, read back
+ * by the same build: a checkpoint whose version or record sizes differ is
+ * ignored. It is replaced atomically, so a crash while writing leaves the
+ * previous one.
+ *
+ * Layout, host byte order:
+ *
+ *   header: warm_restart_header_t
+ *   routes: route_count routing_route_t
+ *   ARP:    arp_count warm_restart_arp_record_t
+ *   MAC:    mac_count mac_table_export_record_t
+ */
+
+#ifndef SDK_ES_SWITCH_SIMULATOR_INCLUDE_MANAGEMENT_WARM_RESTART_H
+#define SDK_ES_SWITCH_SIMULATOR_INCLUDE_MANAGEMENT_WARM_RESTART_H
+
+#include "common/types.h"
+#include "common/error_codes.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define WARM_RESTART_MAGIC              0x52575753  /**< "SWWR" */
+#define WARM_RESTART_VERSION            1
+#define WARM_RESTART_DEFAULT_HOLD_MS    120000      /**< Time given to the protocols to refresh */
+
+/* Checkpoint header */
+typedef struct {
+    uint32_t magic;                 /* WARM_RESTART_MAGIC */
+    uint16_t version;               /* WARM_RESTART_VERSION */
+    uint16_t header_size;           /* sizeof(warm_restart_header_t) */
+    uint16_t route_record_size;     /* sizeof(routing_route_t) */
+    uint16_t arp_record_size;       /* sizeof(warm_restart_arp_record_t) */
+    uint16_t mac_record_size;       /* sizeof(mac_table_export_record_t) */
+    uint16_t reserved;
+    uint32_t route_count;
+    uint32_t arp_count;
+    uint32_t mac_count;
+    uint32_t reserved2;
+    uint64_t timestamp;             /* Wall clock seconds when written */
+} warm_restart_header_t;
+
+/* Resolved ARP entry */
+typedef struct __attribute__((packed)) {
+    uint32_t ip;                    /* As in arp_entry_info_t */
+    uint8_t mac[MAC_ADDR_LEN];
+    uint16_t port_index;
+} warm_restart_arp_record_t;
+
+/* Warm restart parameters */
+typedef struct {
+    uint32_t stale_hold_ms;         /* Restored routes not refreshed by then are removed, 0 to keep them */
+    uint32_t checkpoint_interval_ms; /* Periodic checkpoints, 0 for shutdown only */
+    uint32_t max_age_s;             /* Older checkpoints are ignored, 0 for no limit */
+} warm_restart_config_t;
+
+/* Checkpoint or restore results */
+typedef struct {
+    uint32_t routes;
+    uint32_t arp_entries;
+    uint32_t mac_entries;
+    uint32_t routes_added;          /* Restore: routes new to the routing table */
+    uint64_t age_s;                 /* Restore: age of the checkpoint */
+    uint64_t elapsed_us;
+} warm_restart_stats_t;
+
+/**
+ * @brief Get the default parameters
+ *
+ * Two-minute hold, checkpoints on shutdown only, checkpoints of any age.
+ *
+ * @param[out] config Parameters
+ */
+void warm_restart_get_default_config(warm_restart_config_t *config);
+
+/**
+ * @brief Set the checkpoint file and parameters
+ *
+ * @param path Checkpoint file, kept by reference
+ * @param config Parameters, NULL for the defaults
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t warm_restart_init(const char *path, const warm_restart_config_t *config);
+
+/**
+ * @brief Stop the timers; the checkpoint file is left in place
+ */
+void warm_restart_deinit(void);
+
+/**
+ * @brief Restore the tables from the checkpoint
+ *
+ * Called once the routing, ARP and MAC tables are initialized. Tables not
+ * initialized are skipped. The routes go to the routing table in one batch.
+ *
+ * @param[out] stats Results, may be NULL
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED before
+ *         warm_restart_init(), STATUS_NOT_FOUND if there is no checkpoint,
+ *         STATUS_INVALID_PARAMETER if it is unusable or too old, or the
+ *         routing table error
+ */
+status_t warm_restart_restore(warm_restart_stats_t *stats);
+
+/**
+ * @brief Arm the stale route sweep and the periodic checkpoints
+ *
+ * Needs the event loop.
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, or the timer error
+ */
+status_t warm_restart_start(void);
+
+/**
+ * @brief Write a checkpoint of the current tables
+ *
+ * @param[out] stats Results, may be NULL
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED, STATUS_NO_MEMORY,
+ *         STATUS_FAILURE if the file cannot be written, or the routing table error
+ */
+status_t warm_restart_checkpoint(warm_restart_stats_t *stats);
+
+#endif /* SDK_ES_SWITCH_SIMULATOR_INCLUDE_MANAGEMENT_WARM_RESTART_H */
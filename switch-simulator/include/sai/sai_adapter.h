@@ -14,7 +14,7 @@
 
 // Максимальное количество поддерживаемых объектов
 #define SAI_MAX_PORTS 256
-#define SAI_MAX_VLANS 4096
+#define SAI_MAX_VLANS 4094
 #define SAI_MAX_ROUTER_INTERFACES 128
 #define SAI_MAX_ACL_TABLES 64
 #define SAI_MAX_QUEUES_PER_PORT 8
@@ -32,9 +32,15 @@ typedef enum {
     SAI_OBJECT_TYPE_QOS_MAP,
     SAI_OBJECT_TYPE_TUNNEL,
     SAI_OBJECT_TYPE_MIRROR_SESSION,
-    SAI_OBJECT_TYPE_HOSTIF
+    SAI_OBJECT_TYPE_HOSTIF,
+    SAI_OBJECT_TYPE_MAX           /**< Число типов объектов */
 } sai_object_type_t;
 
+/**
+ * @brief Идентификатор объекта SAI (OID), уникальный в пределах типа
+ */
+typedef uint64_t sai_object_id_t;
+
 /** 
  * @brief Расширенные режимы работы порта 
  */
@@ -102,6 +108,7 @@ typedef enum _sai_status_t {
     SAI_STATUS_API_LOCK_TIMEOUT         = 0x00000020,  /**< API lock timeout */
     SAI_STATUS_MAC_ADDRESS_FAILURE      = 0x00000021,  /**< MAC address failure */
     SAI_STATUS_PORT_STATS_FAILURE       = 0x00000022,  /**< Port statistics failure */
+    SAI_STATUS_NOT_EXECUTED             = 0x00000023,  /**< Bulk object not tried after an earlier failure */
 } sai_status_t;
 
 /**
@@ -194,18 +201,51 @@ typedef struct {
     } object_stats[10];  // Соответствует sai_object_type_t
 } sai_performance_metrics_t;
 
+/**
+ * @brief События FDB, о которых сообщает уведомление
+ */
+typedef enum {
+    SAI_FDB_EVENT_LEARNED,      /**< Динамическая запись изучена или сменила порт */
+    SAI_FDB_EVENT_AGED          /**< Динамическая запись устарела */
+} sai_fdb_event_t;
+
+/**
+ * @brief Данные уведомления о событии FDB
+ */
+typedef struct {
+    sai_fdb_event_t event_type;
+    mac_addr_t mac_address;
+    vlan_id_t vlan_id;
+    port_id_t port_id;          /**< Порт записи; для устаревшей - последний порт */
+} sai_fdb_event_notification_data_t;
+
+/**
+ * @brief Данные уведомления о смене состояния канала порта
+ */
+typedef struct {
+    port_id_t port_id;
+    port_state_t port_state;    /**< PORT_STATE_UP или PORT_STATE_DOWN */
+} sai_port_oper_status_notification_t;
+
 // Типы callback-функций
 typedef void (*sai_object_create_callback)(sai_object_type_t type, uint32_t object_id);
 typedef void (*sai_object_remove_callback)(sai_object_type_t type, uint32_t object_id);
 typedef void (*sai_attribute_change_callback)(sai_object_type_t type, uint32_t object_id, const char *attr_name);
+typedef void (*sai_fdb_event_notification_callback)(uint32_t count, const sai_fdb_event_notification_data_t *data);
+typedef void (*sai_port_state_change_callback)(uint32_t count, const sai_port_oper_status_notification_t *data);
 
 /**
  * @brief Менеджер callback-функций SAI
+ *
+ * Уведомления FDB и портов доставляются пачками из потока уведомлений,
+ * см. sai/sai_notify.h.
  */
 typedef struct {
     sai_object_create_callback on_object_create;
     sai_object_remove_callback on_object_remove;
     sai_attribute_change_callback on_attribute_change;
+    sai_fdb_event_notification_callback on_fdb_event;
+    sai_port_state_change_callback on_port_state_change;
 } sai_callback_manager_t;
 
 // Основные функции SAI адаптера
@@ -221,6 +261,48 @@ status_t sai_adapter_init(hw_context_t *hw_context);
  */
 status_t sai_adapter_deinit(void);
 
+/**
+ * @brief Store a copy of a SAI object, replacing the one with the same OID
+ *
+ * Objects are kept per type in a hash keyed by OID, in fixed-size records:
+ * the first object stored of a type sets the record size of the type.
+ *
+ * @param obj_type Object type, below SAI_OBJECT_TYPE_MAX
+ * @param obj_id Object OID
+ * @param obj_data Object data
+ * @param data_size Size of the data, at most the record size of the type
+ * @return ERROR_SUCCESS or an error code
+ */
+sai_status_t sai_adapter_store_object(uint32_t obj_type, sai_object_id_t obj_id, void *obj_data, size_t data_size);
+
+/**
+ * @brief Copy a stored SAI object out
+ *
+ * @param obj_type Object type
+ * @param obj_id Object OID
+ * @param obj_data Buffer for the data
+ * @param data_size Bytes to copy, at most the record size of the type
+ * @return ERROR_SUCCESS, ERROR_NOT_FOUND or another error code
+ */
+sai_status_t sai_adapter_get_object(uint32_t obj_type, sai_object_id_t obj_id, void *obj_data, size_t data_size);
+
+/**
+ * @brief Remove a stored SAI object
+ *
+ * @param obj_type Object type
+ * @param obj_id Object OID
+ * @return ERROR_SUCCESS, ERROR_NOT_FOUND or another error code
+ */
+sai_status_t sai_adapter_remove_object(uint32_t obj_type, sai_object_id_t obj_id);
+
+/**
+ * @brief Number of stored objects of a type
+ *
+ * @param obj_type Object type
+ * @return Object count, 0 for an unknown type
+ */
+uint32_t sai_adapter_get_object_count(uint32_t obj_type);
+
 /**
  * @brief Configure port with advanced settings and thread-safe operations
  * @param config Advanced port configuration
@@ -240,6 +322,9 @@ status_t sai_remove_port_from_vlan(vlan_id_t vlan_id, port_id_t port_id);
 status_t sai_get_performance_metrics(sai_performance_metrics_t *metrics);
 
 // Callback-менеджмент
+/**
+ * @brief Регистрирует callback-функции, заменяя прежние; NULL-поля отключают их
+ */
 status_t sai_register_callbacks(const sai_callback_manager_t *callbacks);
 
 // Расширенные функции работы с атрибутами
@@ -0,0 +1,211 @@
+/**
+ * @file sai_bulk.h
+ * @brief Switch Abstraction Interface (SAI) bulk object operations
+ *
+ * Bulk calls create or remove many routes, neighbors, FDB entries or VLAN
+ * members at once and report a status for each object. They map onto the
+ * batched calls of the layers below: a bulk route call holds the routing
+ * table lock once and commits the FIB once, a bulk VLAN member call takes
+ * the VLAN lock once, and a bulk neighbor call takes the neighbor table
+ * lock once per ARP_BULK_MAX neighbors.
+ */
+
+#ifndef SAI_BULK_H
+#define SAI_BULK_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "../l3/ip.h"
+#include "sai_adapter.h"
+#include "sai_vlan.h"
+
+/**
+ * @brief What a bulk call does after an object fails
+ */
+typedef enum sai_bulk_op_error_mode_e {
+    SAI_BULK_OP_ERROR_MODE_STOP_ON_ERROR,   /**< Objects after the failed one get SAI_STATUS_NOT_EXECUTED */
+    SAI_BULK_OP_ERROR_MODE_IGNORE_ERROR     /**< Every object is tried */
+} sai_bulk_op_error_mode_t;
+
+/**
+ * @brief Route of the default virtual router, for bulk calls
+ */
+typedef struct sai_bulk_route_entry_s {
+    ip_addr_t destination;       /**< Prefix; its type selects the address family */
+    uint8_t prefix_len;          /**< Prefix length */
+    ip_addr_t next_hop;          /**< Next hop address, unused on removal */
+    uint16_t interface_index;    /**< Outgoing interface, unused on removal */
+    uint16_t metric;             /**< Route metric, unused on removal */
+} sai_bulk_route_entry_t;
+
+/**
+ * @brief Neighbor entry, for bulk calls
+ */
+typedef struct sai_bulk_neighbor_entry_s {
+    ip_addr_t ip_address;        /**< IPv4 or IPv6 address of the neighbor */
+    mac_addr_t mac_address;      /**< MAC address, unused on removal */
+    uint16_t port_index;         /**< Port the neighbor is on, unused on removal */
+} sai_bulk_neighbor_entry_t;
+
+/**
+ * @brief FDB entry, for bulk calls
+ */
+typedef struct sai_bulk_fdb_entry_s {
+    mac_addr_t mac_address;      /**< MAC address */
+    vlan_id_t vlan_id;           /**< VLAN of the entry */
+    port_id_t port_id;           /**< Bridge port, unused on removal */
+    bool is_static;              /**< Static entry, never aged; unused on removal */
+} sai_bulk_fdb_entry_t;
+
+/**
+ * @brief VLAN member, for bulk calls
+ */
+typedef struct sai_bulk_vlan_member_s {
+    sai_vlan_id_t vlan_id;                  /**< VLAN ID */
+    sai_port_id_t port_id;                  /**< Port ID */
+    sai_vlan_tagging_mode_t tagging_mode;   /**< Tagging mode; priority tagging is not supported */
+} sai_bulk_vlan_member_t;
+
+/**
+ * @brief Create routes in bulk
+ *
+ * Routes are static routes of the default virtual router.
+ *
+ * @param[in]  object_count     Number of routes
+ * @param[in]  route_entries    Routes to create
+ * @param[in]  mode             Error mode
+ * @param[out] object_statuses  Status of each route
+ *
+ * @return SAI_STATUS_SUCCESS if every route was created, SAI_STATUS_FAILURE otherwise
+ */
+sai_status_t sai_bulk_create_route_entry(
+    uint32_t object_count,
+    const sai_bulk_route_entry_t *route_entries,
+    sai_bulk_op_error_mode_t mode,
+    sai_status_t *object_statuses
+);
+
+/**
+ * @brief Remove static routes in bulk
+ *
+ * @param[in]  object_count     Number of routes
+ * @param[in]  route_entries    Routes to remove, by prefix
+ * @param[in]  mode             Error mode
+ * @param[out] object_statuses  Status of each route
+ *
+ * @return SAI_STATUS_SUCCESS if every route was removed, SAI_STATUS_FAILURE otherwise
+ */
+sai_status_t sai_bulk_remove_route_entry(
+    uint32_t object_count,
+    const sai_bulk_route_entry_t *route_entries,
+    sai_bulk_op_error_mode_t mode,
+    sai_status_t *object_statuses
+);
+
+/**
+ * @brief Create or update neighbors in bulk
+ *
+ * IPv4 neighbors go to the ARP table, IPv6 neighbors to the ND cache.
+ *
+ * @param[in]  object_count      Number of neighbors
+ * @param[in]  neighbor_entries  Neighbors to create
+ * @param[in]  mode              Error mode
+ * @param[out] object_statuses   Status of each neighbor
+ *
+ * @return SAI_STATUS_SUCCESS if every neighbor was created, SAI_STATUS_FAILURE otherwise
+ */
+sai_status_t sai_bulk_create_neighbor_entry(
+    uint32_t object_count,
+    const sai_bulk_neighbor_entry_t *neighbor_entries,
+    sai_bulk_op_error_mode_t mode,
+    sai_status_t *object_statuses
+);
+
+/**
+ * @brief Remove neighbors in bulk
+ *
+ * @param[in]  object_count      Number of neighbors
+ * @param[in]  neighbor_entries  Neighbors to remove, by address
+ * @param[in]  mode              Error mode
+ * @param[out] object_statuses   Status of each neighbor
+ *
+ * @return SAI_STATUS_SUCCESS if every neighbor was removed, SAI_STATUS_FAILURE otherwise
+ */
+sai_status_t sai_bulk_remove_neighbor_entry(
+    uint32_t object_count,
+    const sai_bulk_neighbor_entry_t *neighbor_entries,
+    sai_bulk_op_error_mode_t mode,
+    sai_status_t *object_statuses
+);
+
+/**
+ * @brief Create or update FDB entries in bulk
+ *
+ * @param[in]  object_count     Number of entries
+ * @param[in]  fdb_entries      Entries to create
+ * @param[in]  mode             Error mode
+ * @param[out] object_statuses  Status of each entry
+ *
+ * @return SAI_STATUS_SUCCESS if every entry was created, SAI_STATUS_FAILURE otherwise
+ */
+sai_status_t sai_bulk_create_fdb_entry(
+    uint32_t object_count,
+    const sai_bulk_fdb_entry_t *fdb_entries,
+    sai_bulk_op_error_mode_t mode,
+    sai_status_t *object_statuses
+);
+
+/**
+ * @brief Remove FDB entries in bulk
+ *
+ * @param[in]  object_count     Number of entries
+ * @param[in]  fdb_entries      Entries to remove, by MAC address and VLAN
+ * @param[in]  mode             Error mode
+ * @param[out] object_statuses  Status of each entry
+ *
+ * @return SAI_STATUS_SUCCESS if every entry was removed, SAI_STATUS_FAILURE otherwise
+ */
+sai_status_t sai_bulk_remove_fdb_entry(
+    uint32_t object_count,
+    const sai_bulk_fdb_entry_t *fdb_entries,
+    sai_bulk_op_error_mode_t mode,
+    sai_status_t *object_statuses
+);
+
+/**
+ * @brief Create VLAN members in bulk
+ *
+ * @param[in]  object_count     Number of members
+ * @param[in]  members          Members to create
+ * @param[in]  mode             Error mode
+ * @param[out] member_ids       ID of each member created, see SAI_VLAN_MEMBER_ID(); may be NULL
+ * @param[out] object_statuses  Status of each member
+ *
+ * @return SAI_STATUS_SUCCESS if every member was created, SAI_STATUS_FAILURE otherwise
+ */
+sai_status_t sai_bulk_create_vlan_member(
+    uint32_t object_count,
+    const sai_bulk_vlan_member_t *members,
+    sai_bulk_op_error_mode_t mode,
+    sai_vlan_member_id_t *member_ids,
+    sai_status_t *object_statuses
+);
+
+/**
+ * @brief Remove VLAN members in bulk
+ *
+ * @param[in]  object_count     Number of members
+ * @param[in]  member_ids       Members to remove
+ * @param[in]  mode             Error mode
+ * @param[out] object_statuses  Status of each member
+ *
+ * @return SAI_STATUS_SUCCESS if every member was removed, SAI_STATUS_FAILURE otherwise
+ */
+sai_status_t sai_bulk_remove_vlan_member(
+    uint32_t object_count,
+    const sai_vlan_member_id_t *member_ids,
+    sai_bulk_op_error_mode_t mode,
+    sai_status_t *object_statuses
+);
+
+#endif /* SAI_BULK_H */
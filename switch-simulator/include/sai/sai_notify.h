@@ -0,0 +1,75 @@
+/**
+ * @file sai_notify.h
+ * @brief Switch Abstraction Interface (SAI) FDB and port notifications
+ *
+ * FDB learn and age events of the MAC table and link changes of the
+ * ports are posted to a lock-free ring, without blocking and without
+ * allocating: learning never waits for the NOS. A notification thread
+ * drains the ring in batches of up to CONFIG_SAI_NOTIFY_BATCH events,
+ * coalesces each batch and hands it to the callbacks registered with
+ * sai_register_callbacks().
+ *
+ * Within a batch, an entry learned and then aged is not reported at all,
+ * later events of an entry replace earlier ones, and only the last link
+ * state of a port is reported. FDB events of a batch are delivered before
+ * its port events.
+ */
+
+#ifndef SAI_NOTIFY_H
+#define SAI_NOTIFY_H
+
+#include "../common/types.h"
+#include "../common/error_codes.h"
+#include "sai_adapter.h"
+
+/**
+ * @brief Notification counters
+ */
+typedef struct sai_notify_stats_s {
+    uint64_t posted;        /**< Events put on the ring */
+    uint64_t dropped;       /**< Events lost to a full ring */
+    uint64_t coalesced;     /**< Events folded into others or cancelled */
+    uint64_t delivered;     /**< Events handed to callbacks */
+    uint64_t batches;       /**< Batches delivered */
+} sai_notify_stats_t;
+
+/**
+ * @brief Start the notification channel
+ *
+ * Subscribes to the MAC table and port link events and starts the
+ * notification thread. Called by sai_adapter_init().
+ *
+ * @return SAI_STATUS_SUCCESS or an error status
+ */
+sai_status_t sai_notify_init(void);
+
+/**
+ * @brief Stop the notification channel
+ *
+ * Unsubscribes, delivers the events left on the ring and stops the
+ * thread. Called by sai_adapter_deinit().
+ *
+ * @return SAI_STATUS_SUCCESS or SAI_STATUS_UNINITIALIZED
+ */
+sai_status_t sai_notify_deinit(void);
+
+/**
+ * @brief Set the callbacks batches are delivered to
+ *
+ * Events of a kind without a callback are drained and dropped.
+ *
+ * @param fdb_callback FDB event callback, may be NULL
+ * @param port_callback Port link state callback, may be NULL
+ */
+void sai_notify_set_callbacks(sai_fdb_event_notification_callback fdb_callback,
+                              sai_port_state_change_callback port_callback);
+
+/**
+ * @brief Read the notification counters
+ *
+ * @param[out] stats Counters
+ * @return SAI_STATUS_SUCCESS or SAI_STATUS_INVALID_PARAMETER
+ */
+sai_status_t sai_notify_get_stats(sai_notify_stats_t *stats);
+
+#endif /* SAI_NOTIFY_H */
@@ -18,7 +18,7 @@
 /**
  * @brief Maximum number of ports supported by the switch
  */
-#define SAI_MAX_PORTS 64
+#define SAI_MAX_PORTS 256
 
 /**
  * @brief Port operational states
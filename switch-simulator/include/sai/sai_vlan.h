@@ -81,6 +81,8 @@ typedef enum sai_vlan_member_attr_id_e {
     SAI_VLAN_MEMBER_ATTR_VLAN_ID,       /**< VLAN ID [sai_vlan_id_t] */
     SAI_VLAN_MEMBER_ATTR_PORT_ID,       /**< Port ID [sai_port_id_t] */
     SAI_VLAN_MEMBER_ATTR_TAGGING_MODE,  /**< Tagging mode [sai_vlan_tagging_mode_t] */
+    SAI_VLAN_MEMBER_ATTR_INGRESS_VID,   /**< VID received for this VLAN on the port (WRITE-ONLY) [sai_vlan_id_t] */
+    SAI_VLAN_MEMBER_ATTR_EGRESS_VID,    /**< VID transmitted for this VLAN on the port, 0 for none (WRITE-ONLY) [sai_vlan_id_t] */
     SAI_VLAN_MEMBER_ATTR_MAX            /**< Max attribute ID */
 } sai_vlan_member_attr_id_t;
 
@@ -93,6 +95,7 @@ typedef struct sai_vlan_member_attr_s {
         sai_vlan_id_t vlan_id;              /**< VLAN ID */
         sai_port_id_t port_id;              /**< Port ID */
         sai_vlan_tagging_mode_t tagging_mode; /**< Tagging mode */
+        sai_vlan_id_t translated_vid;       /**< Translated VID */
     } value;                              /**< Attribute value */
 } sai_vlan_member_attr_t;
 
@@ -101,6 +104,14 @@ typedef struct sai_vlan_member_attr_s {
  */
 typedef uint32_t sai_vlan_member_id_t;
 
+/**
+ * @brief VLAN member ID encoding: VLAN ID in the upper 16 bits, port ID in the lower 16
+ */
+#define SAI_VLAN_MEMBER_ID(vlan_id, port_id) \
+    ((sai_vlan_member_id_t)(((uint32_t)(vlan_id) << 16) | ((uint32_t)(port_id) & 0xFFFF)))
+#define SAI_VLAN_MEMBER_ID_VLAN(member_id) ((sai_vlan_id_t)((member_id) >> 16))
+#define SAI_VLAN_MEMBER_ID_PORT(member_id) ((sai_port_id_t)((member_id) & 0xFFFF))
+
 /**
  * @brief VLAN statistics counter IDs
  */
@@ -241,6 +252,9 @@ sai_status_t sai_remove_vlan_member(
 /**
  * @brief Set VLAN member attribute
  *
+ * SAI_VLAN_MEMBER_ATTR_INGRESS_VID and SAI_VLAN_MEMBER_ATTR_EGRESS_VID
+ * program the port's direct-indexed VID translation tables.
+ *
  * @param[in] vlan_member_id  VLAN member ID
  * @param[in] attr            Attribute to be set
  *
@@ -309,4 +323,51 @@ sai_status_t sai_get_vlan_list(
     sai_vlan_id_t *vlan_list
 );
 
+/**
+ * @brief Create every VLAN in a range in one operation
+ *
+ * Nothing is created if any VLAN in the range already exists.
+ *
+ * @param[in] first_vlan  First VLAN ID of the range
+ * @param[in] last_vlan   Last VLAN ID of the range (inclusive)
+ *
+ * @return SAI_STATUS_SUCCESS on success or error code on failure
+ */
+sai_status_t sai_vlan_create_range(
+    sai_vlan_id_t first_vlan,
+    sai_vlan_id_t last_vlan
+);
+
+/**
+ * @brief Add a set of ports to every VLAN in a range in one operation
+ *
+ * @param[in] first_vlan    First VLAN ID of the range
+ * @param[in] last_vlan     Last VLAN ID of the range (inclusive)
+ * @param[in] port_bitmap   Port bitmap, bit n of word n / 64 set for port n
+ * @param[in] port_words    Number of 64-bit words in port_bitmap
+ * @param[in] tagging_mode  Tagging mode of the new members
+ *
+ * @return SAI_STATUS_SUCCESS on success or error code on failure
+ */
+sai_status_t sai_vlan_add_ports_bitmap(
+    sai_vlan_id_t first_vlan,
+    sai_vlan_id_t last_vlan,
+    const uint64_t *port_bitmap,
+    uint32_t port_words,
+    sai_vlan_tagging_mode_t tagging_mode
+);
+
+/**
+ * @brief Replace the set of VLANs allowed on a trunk port
+ *
+ * @param[in] port_id      Port ID
+ * @param[in] vlan_bitmap  VLAN bitmap of 64 words, bit n set for VLAN n
+ *
+ * @return SAI_STATUS_SUCCESS on success or error code on failure
+ */
+sai_status_t sai_vlan_set_trunk_allowed_bitmap(
+    sai_port_id_t port_id,
+    const uint64_t *vlan_bitmap
+);
+
 #endif /* SAI_VLAN_H */
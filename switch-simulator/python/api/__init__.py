@@ -8,10 +8,17 @@ and viewing real-time statistics.
 
 from .switch_controller import SwitchController, SwitchInterface, SwitchConfig
 from .stats_viewer import StatsViewer
+from .events import SwitchEvent, EventSubscription, EVENT_KINDS
+from .mgmt_client import MgmtClient, MgmtError
 
 __all__ = [
     'SwitchController',
     'SwitchInterface',
     'SwitchConfig',
     'StatsViewer',
+    'SwitchEvent',
+    'EventSubscription',
+    'EVENT_KINDS',
+    'MgmtClient',
+    'MgmtError',
 ]
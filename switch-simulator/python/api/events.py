@@ -0,0 +1,231 @@
+"""
+Event subscriptions for the Switch Simulator Python API
+
+MAC learn and age, link, route and STP role events are posted by the
+simulator to the event feed ring (include/common/event_feed.h), which
+comes with an eventfd. The feed reader watches that eventfd from an
+asyncio loop, so subscribers wake as soon as events arrive instead of
+polling on a timer:
+
+    async with controller.subscribe_events({"mac_learn"}) as events:
+        send_frames()
+        event = await events.wait_for(lambda e: e.mac == "00:11:22:33:44:55",
+                                      timeout=2.0)
+"""
+
+import asyncio
+import ctypes
+import socket
+import logging
+from dataclasses import dataclass
+from typing import Callable, Iterable, List, Optional
+
+logger = logging.getLogger(__name__)
+
+# event_feed_kind_t
+EVENT_KINDS = ("mac_learn", "mac_age", "link", "route_add", "route_delete",
+               "route_change", "stp_role")
+ALL_EVENT_KINDS = frozenset(EVENT_KINDS)
+
+_READ_BATCH = 512
+_LINK_STATES = {0: "down", 1: "up"}
+_STP_ROLES = {0: "disabled", 1: "root", 2: "designated", 3: "alternate", 4: "backup"}
+
+
+class EventFeedRecord(ctypes.Structure):
+    """event_feed_event_t"""
+    _fields_ = [
+        ("timestamp_us", ctypes.c_uint64),
+        ("kind", ctypes.c_uint16),
+        ("port_id", ctypes.c_uint16),
+        ("vlan_id", ctypes.c_uint16),
+        ("old_value", ctypes.c_uint8),
+        ("new_value", ctypes.c_uint8),
+        ("mac", ctypes.c_uint8 * 6),
+        ("prefix_len", ctypes.c_uint8),
+        ("is_ipv6", ctypes.c_uint8),
+        ("addr", ctypes.c_uint8 * 16),
+    ]
+
+
+@dataclass
+class SwitchEvent:
+    """One event of the feed; fields a kind does not use are None"""
+    kind: str
+    timestamp_us: int
+    port_id: Optional[int] = None
+    vlan_id: Optional[int] = None
+    mac: Optional[str] = None
+    state: Optional[str] = None
+    old_role: Optional[str] = None
+    new_role: Optional[str] = None
+    vrf_id: Optional[int] = None
+    prefix: Optional[str] = None
+
+    @classmethod
+    def from_record(cls, record: EventFeedRecord) -> 'SwitchEvent':
+        kind = EVENT_KINDS[record.kind] if record.kind < len(EVENT_KINDS) else f"unknown_{record.kind}"
+        event = cls(kind=kind, timestamp_us=record.timestamp_us)
+        if kind in ("mac_learn", "mac_age"):
+            event.port_id = record.port_id
+            event.vlan_id = record.vlan_id
+            event.mac = ":".join(f"{b:02X}" for b in record.mac)
+        elif kind == "link":
+            event.port_id = record.port_id
+            event.state = _LINK_STATES.get(record.new_value, str(record.new_value))
+        elif kind == "stp_role":
+            event.port_id = record.port_id
+            event.old_role = _STP_ROLES.get(record.old_value, str(record.old_value))
+            event.new_role = _STP_ROLES.get(record.new_value, str(record.new_value))
+        elif kind.startswith("route_"):
+            family = socket.AF_INET6 if record.is_ipv6 else socket.AF_INET
+            address = bytes(record.addr)[:16 if record.is_ipv6 else 4]
+            event.vrf_id = record.vlan_id
+            event.prefix = f"{socket.inet_ntop(family, address)}/{record.prefix_len}"
+        return event
+
+
+def _kind_mask(kinds: Iterable[str]) -> int:
+    mask = 0
+    for kind in kinds:
+        if kind not in ALL_EVENT_KINDS:
+            raise ValueError(f"Unknown event kind: {kind}")
+        mask |= 1 << EVENT_KINDS.index(kind)
+    return mask
+
+
+def configure_event_feed_signatures(lib):
+    """Set the ctypes signatures of the event feed functions"""
+    lib.event_feed_subscribe.argtypes = [ctypes.c_uint32, ctypes.POINTER(ctypes.c_int)]
+    lib.event_feed_subscribe.restype = ctypes.c_int
+    lib.event_feed_read.argtypes = [ctypes.POINTER(EventFeedRecord), ctypes.c_uint32,
+                                    ctypes.POINTER(ctypes.c_uint32)]
+    lib.event_feed_read.restype = ctypes.c_int
+
+
+class EventSubscription:
+    """
+    Events of some kinds, queued as they arrive
+
+    Use as an async context manager and iterate, or await next_event() or
+    wait_for(). Leaving the context ends the subscription.
+    """
+
+    def __init__(self, reader: 'EventFeedReader', kinds: Iterable[str]):
+        self._reader = reader
+        self.kinds = frozenset(kinds)
+        self._queue: asyncio.Queue = asyncio.Queue()
+
+    def _deliver(self, event: SwitchEvent):
+        if event.kind in self.kinds:
+            self._queue.put_nowait(event)
+
+    async def next_event(self, timeout: Optional[float] = None) -> SwitchEvent:
+        """Next event; raises asyncio.TimeoutError after timeout seconds"""
+        return await asyncio.wait_for(self._queue.get(), timeout)
+
+    async def wait_for(self, predicate: Callable[[SwitchEvent], bool],
+                       timeout: Optional[float] = None) -> SwitchEvent:
+        """
+        First event matching predicate; earlier events are discarded
+
+        Raises asyncio.TimeoutError if none arrives within timeout seconds.
+        """
+        async def match():
+            while True:
+                event = await self._queue.get()
+                if predicate(event):
+                    return event
+        return await asyncio.wait_for(match(), timeout)
+
+    def drain(self) -> List[SwitchEvent]:
+        """Events queued so far, without waiting"""
+        events = []
+        while not self._queue.empty():
+            events.append(self._queue.get_nowait())
+        return events
+
+    def close(self):
+        self._reader.remove(self)
+
+    def __aiter__(self):
+        return self
+
+    async def __anext__(self) -> SwitchEvent:
+        return await self._queue.get()
+
+    async def __aenter__(self) -> 'EventSubscription':
+        return self
+
+    async def __aexit__(self, exc_type, exc, tb):
+        self.close()
+
+
+class EventFeedReader:
+    """
+    Single consumer of the event feed, shared by the subscriptions of a loop
+
+    The feed is subscribed to the union of the kinds of all subscriptions.
+    Events are read in batches whenever the eventfd becomes readable and
+    handed to every subscription that wants their kind.
+    """
+
+    def __init__(self, lib):
+        self._lib = lib
+        self._loop: Optional[asyncio.AbstractEventLoop] = None
+        self._fd = -1
+        self._subscriptions: List[EventSubscription] = []
+        self._records = (EventFeedRecord * _READ_BATCH)()
+
+    def _resubscribe(self):
+        kinds = set()
+        for subscription in self._subscriptions:
+            kinds |= subscription.kinds
+        fd = ctypes.c_int(-1)
+        result = self._lib.event_feed_subscribe(_kind_mask(kinds), ctypes.byref(fd))
+        if result != 0:
+            raise RuntimeError(f"Failed to subscribe to the event feed: error code {result}")
+        return fd.value
+
+    def add(self, kinds: Iterable[str], loop: Optional[asyncio.AbstractEventLoop] = None) -> EventSubscription:
+        loop = loop or asyncio.get_running_loop()
+        if self._loop is not None and self._loop is not loop:
+            raise RuntimeError("Event subscriptions are bound to one event loop")
+
+        subscription = EventSubscription(self, kinds)
+        self._subscriptions.append(subscription)
+        try:
+            fd = self._resubscribe()
+        except Exception:
+            self._subscriptions.remove(subscription)
+            raise
+
+        if self._loop is None:
+            self._loop = loop
+            self._fd = fd
+            loop.add_reader(fd, self._on_readable)
+        return subscription
+
+    def remove(self, subscription: EventSubscription):
+        if subscription not in self._subscriptions:
+            return
+        self._subscriptions.remove(subscription)
+        self._resubscribe()
+        if not self._subscriptions and self._loop is not None:
+            # Events still on the ring are read by the next subscriber
+            self._loop.remove_reader(self._fd)
+            self._loop = None
+
+    def _on_readable(self):
+        count = ctypes.c_uint32(0)
+        while True:
+            result = self._lib.event_feed_read(self._records, _READ_BATCH, ctypes.byref(count))
+            if result != 0:
+                logger.error(f"Failed to read the event feed: error code {result}")
+                return
+            for record in self._records[:count.value]:
+                event = SwitchEvent.from_record(record)
+                for subscription in self._subscriptions:
+                    subscription._deliver(event)
+            if count.value < _READ_BATCH:
+                return
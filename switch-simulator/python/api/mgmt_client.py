@@ -0,0 +1,235 @@
+"""
+Management Server Client for Switch Simulator
+
+This module talks to the simulator's management server (see
+include/management/mgmt_server.h) over one persistent HTTP/1.1
+connection. Table reads and writes are single batch requests of packed
+rows, and requests can be pipelined: pipeline() sends them all before
+reading the first answer.
+"""
+
+import ipaddress
+import json
+import socket
+import struct
+from typing import Any, Dict, Iterable, List, Optional, Sequence, Tuple
+
+# Rows as mgmt_route_record_t / mgmt_mac_record_t / mgmt_vlan_member_record_t
+ROUTE_RECORD = struct.Struct('=16s16sBBHHBB')
+MAC_RECORD = struct.Struct('=6sHHBBI')
+VLAN_MEMBER_RECORD = struct.Struct('=HHB3x')
+STATUS = struct.Struct('=i')
+
+PORT_COUNTER_NAMES = (
+    "rx_packets", "tx_packets", "rx_bytes", "tx_bytes", "rx_errors", "tx_errors",
+    "rx_dropped", "tx_dropped", "rx_unicast", "tx_unicast", "rx_broadcast", "tx_broadcast",
+    "rx_multicast", "tx_multicast", "collisions",
+)
+VLAN_COUNTER_NAMES = ("rx_packets", "rx_bytes", "tx_packets", "tx_bytes")
+
+Route = Tuple[str, Optional[str], int, int]     # prefix/len, next hop, interface, metric
+
+
+class MgmtError(Exception):
+    """Request answered with an error; status is the simulator's status_t"""
+
+    def __init__(self, code: int, status: Optional[int], path: str):
+        super().__init__(f"{path}: HTTP {code}, status {status}")
+        self.code = code
+        self.status = status
+
+
+class MgmtClient:
+    """
+    Client of the management server
+
+    Args:
+        host: Server address
+        port: Server port
+        timeout: Socket timeout in seconds
+    """
+
+    def __init__(self, host: str = '127.0.0.1', port: int = 8000, timeout: float = 10.0):
+        self.host = host
+        self.port = port
+        self.timeout = timeout
+        self._sock: Optional[socket.socket] = None
+        self._buf = b''
+
+    def close(self) -> None:
+        if self._sock:
+            self._sock.close()
+            self._sock = None
+            self._buf = b''
+
+    def __enter__(self) -> 'MgmtClient':
+        return self
+
+    def __exit__(self, *exc) -> None:
+        self.close()
+
+    def _connect(self) -> socket.socket:
+        if self._sock is None:
+            self._sock = socket.create_connection((self.host, self.port), self.timeout)
+            self._sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        return self._sock
+
+    @staticmethod
+    def _encode(method: str, path: str, body: bytes = b'', content_type: str = 'application/octet-stream') -> bytes:
+        head = f"{method} {path} HTTP/1.1\r\nHost: switch\r\n"
+        if body or method in ('POST', 'PUT', 'DELETE'):
+            head += f"Content-Type: {content_type}\r\nContent-Length: {len(body)}\r\n"
+        return head.encode() + b'\r\n' + body
+
+    def _read_answer(self, path: str) -> Tuple[int, bytes, bool]:
+        sock = self._sock
+        while True:
+            while b'\r\n\r\n' not in self._buf:
+                chunk = sock.recv(65536)
+                if not chunk:
+                    self.close()
+                    raise ConnectionError("management server closed the connection")
+                self._buf += chunk
+            head, self._buf = self._buf.split(b'\r\n\r\n', 1)
+            lines = head.decode('latin-1').split('\r\n')
+            code = int(lines[0].split()[1])
+            if code != 100:
+                break
+        length = 0
+        close = False
+        for line in lines[1:]:
+            name, _, value = line.partition(':')
+            name = name.strip().lower()
+            if name == 'content-length':
+                length = int(value)
+            elif name == 'connection' and value.strip().lower() == 'close':
+                close = True
+        while len(self._buf) < length:
+            chunk = sock.recv(max(65536, length - len(self._buf)))
+            if not chunk:
+                self.close()
+                raise ConnectionError("management server closed the connection")
+            self._buf += chunk
+        body, self._buf = self._buf[:length], self._buf[length:]
+        return code, body, close
+
+    def pipeline(self, requests: Sequence[Tuple[str, str, bytes]]) -> List[Tuple[int, bytes]]:
+        """
+        Send requests back to back and read their answers
+
+        Args:
+            requests: (method, path, body) tuples
+
+        Returns:
+            (HTTP status, body) of each request, in order
+        """
+        sock = self._connect()
+        sock.sendall(b''.join(self._encode(m, p, b) for m, p, b in requests))
+        answers = []
+        for _method, path, _body in requests:
+            code, body, close = self._read_answer(path)
+            answers.append((code, body))
+            if close:
+                self.close()
+                break
+        return answers
+
+    def request(self, method: str, path: str, body: bytes = b'') -> bytes:
+        """Send one request; raises MgmtError on an error answer"""
+        code, answer = self.pipeline([(method, path, body)])[0]
+        if code >= 400:
+            try:
+                status = json.loads(answer).get('status')
+            except ValueError:
+                status = None
+            raise MgmtError(code, status, path)
+        return answer
+
+    # Server and configuration
+
+    def server_stats(self) -> Dict[str, int]:
+        return json.loads(self.request('GET', '/v1/server'))
+
+    def memory_report(self) -> str:
+        return self.request('GET', '/v1/memory').decode()
+
+    def get_param(self, key: str) -> str:
+        return self.request('GET', f'/v1/config/{key}').decode()
+
+    def set_param(self, key: str, value: str) -> None:
+        self.request('PUT', f'/v1/config/{key}', value.encode())
+
+    def apply_config(self, config: Any) -> Dict[str, int]:
+        """Apply a JSON configuration (a string or an object to serialize); returns the diff counters"""
+        data = config if isinstance(config, (bytes, str)) else json.dumps(config)
+        return json.loads(self.request('POST', '/v1/config', data.encode() if isinstance(data, str) else data))
+
+    # Routes
+
+    @staticmethod
+    def _pack_route(route: Route) -> bytes:
+        prefix, next_hop, interface, metric = route
+        net = ipaddress.ip_network(prefix, strict=False)
+        hop = ipaddress.ip_address(next_hop).packed if next_hop else b''
+        return ROUTE_RECORD.pack(net.network_address.packed, hop, int(net.version == 6),
+                                 net.prefixlen, interface, metric, 0, 0)
+
+    def routes(self) -> List[Dict[str, Any]]:
+        rows = []
+        for prefix, hop, v6, plen, interface, metric, source, _ in ROUTE_RECORD.iter_unpack(
+                self.request('GET', '/v1/routes')):
+            size = 16 if v6 else 4
+            rows.append({
+                'prefix': f"{ipaddress.ip_address(prefix[:size])}/{plen}",
+                'next_hop': str(ipaddress.ip_address(hop[:size])) if any(hop) else None,
+                'interface': interface,
+                'metric': metric,
+                'source': source,
+            })
+        return rows
+
+    def add_routes(self, routes: Iterable[Route]) -> List[int]:
+        """Add routes in one batch; returns the status of each"""
+        body = b''.join(self._pack_route(r) for r in routes)
+        return [s for (s,) in STATUS.iter_unpack(self.request('POST', '/v1/routes', body))]
+
+    def delete_routes(self, routes: Iterable[Route]) -> List[int]:
+        body = b''.join(self._pack_route(r) for r in routes)
+        return [s for (s,) in STATUS.iter_unpack(self.request('DELETE', '/v1/routes', body))]
+
+    # MAC table and VLAN membership
+
+    def macs(self) -> List[Dict[str, Any]]:
+        return [{'mac': mac.hex(':'), 'vlan': vlan, 'port': port, 'type': kind, 'age': age}
+                for mac, vlan, port, kind, _, age in MAC_RECORD.iter_unpack(self.request('GET', '/v1/macs'))]
+
+    def add_macs(self, entries: Iterable[Tuple[str, int, int]], remove: bool = False) -> List[int]:
+        """Add (or remove) static (mac, vlan, port) entries in one batch"""
+        body = b''.join(MAC_RECORD.pack(bytes.fromhex(mac.replace(':', '')), vlan, port, 0, 0, 0)
+                        for mac, vlan, port in entries)
+        answer = self.request('DELETE' if remove else 'POST', '/v1/macs', body)
+        return [s for (s,) in STATUS.iter_unpack(answer)]
+
+    def vlan_members(self) -> List[Tuple[int, int, bool]]:
+        return [(vlan, port, bool(tagged))
+                for vlan, port, tagged in VLAN_MEMBER_RECORD.iter_unpack(self.request('GET', '/v1/vlan-members'))]
+
+    def set_vlan_members(self, members: Iterable[Tuple[int, int, bool]], remove: bool = False) -> List[int]:
+        body = b''.join(VLAN_MEMBER_RECORD.pack(vlan, port, int(tagged)) for vlan, port, tagged in members)
+        answer = self.request('DELETE' if remove else 'POST', '/v1/vlan-members', body)
+        return [s for (s,) in STATUS.iter_unpack(answer)]
+
+    # Counters
+
+    def _counters(self, path: str, ids: Sequence[int], names: Sequence[str]) -> Dict[int, Dict[str, int]]:
+        count = len(ids)
+        matrix = struct.unpack(f'={len(names) * count}Q',
+                               self.request('POST', path, struct.pack(f'={count}H', *ids)))
+        return {obj: {name: matrix[row * count + i] for row, name in enumerate(names)}
+                for i, obj in enumerate(ids)}
+
+    def port_counters(self, ports: Sequence[int]) -> Dict[int, Dict[str, int]]:
+        return self._counters('/v1/port-counters', ports, PORT_COUNTER_NAMES)
+
+    def vlan_counters(self, vlans: Sequence[int]) -> Dict[int, Dict[str, int]]:
+        return self._counters('/v1/vlan-counters', vlans, VLAN_COUNTER_NAMES)
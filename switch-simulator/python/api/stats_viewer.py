@@ -8,6 +8,8 @@ including port statistics, VLAN usage, MAC table entries, and routing informatio
 import os
 import sys
 import time
+import mmap
+import struct
 from typing import Dict, List, Optional, Tuple, Union, Any
 import logging
 import threading
@@ -28,17 +30,278 @@ except ImportError:
     logger.warning("Could not import SwitchController, some functionality may be limited")
 
 
+class SharedStatsReader:
+    """
+    Reads the counters the simulator publishes in shared memory
+
+    The layout is documented in include/management/stats_export.h. A whole
+    table is copied in one slice under the segment's sequence lock, so
+    reading every port or VLAN costs no call into the simulator.
+    """
+
+    MAGIC = 0x54535753
+    VERSION_MAJOR = 1
+    HEADER = struct.Struct('<IHHIIQQQQ12I')
+    SEQUENCE_OFFSET = 24
+
+    PORT_FIELDS = ('rx_packets', 'tx_packets', 'rx_bytes', 'tx_bytes',
+                   'rx_errors', 'tx_errors', 'rx_drops', 'tx_drops',
+                   'rx_unicast', 'tx_unicast', 'rx_broadcast', 'tx_broadcast',
+                   'rx_multicast', 'tx_multicast', 'collisions', 'last_clear')
+    VLAN_FIELDS = ('rx_packets', 'tx_packets', 'rx_bytes', 'tx_bytes',
+                   'storm_dropped_packets', 'storm_dropped_bytes', 'last_clear')
+    QUEUE_FIELDS = ('enqueued', 'dequeued', 'dropped', 'current_depth',
+                    'max_depth', 'last_clear')
+    ROUTING_FIELDS = ('routed_packets', 'routed_bytes', 'routing_failures',
+                      'arp_requests', 'arp_replies', 'last_clear')
+
+    def __init__(self, name: str = '/switch_sim_stats'):
+        """
+        Map a statistics segment read-only
+
+        Args:
+            name: Segment name as passed to the simulator's -s option
+
+        Raises:
+            OSError: If the segment does not exist
+            ValueError: If the segment has an unknown layout
+        """
+        path = os.path.join('/dev/shm', name.lstrip('/'))
+        fd = os.open(path, os.O_RDONLY)
+        try:
+            self._map = mmap.mmap(fd, 0, mmap.MAP_SHARED, mmap.PROT_READ)
+        finally:
+            os.close(fd)
+
+        (magic, major, _minor, _header_size, self.writer_pid, total_size,
+         _sequence, _update_ns, _updates, self.port_count, self.vlan_count,
+         self.queues_per_port, _reserved,
+         self._port_offset, self._port_size, self._vlan_offset, self._vlan_size,
+         self._queue_offset, self._queue_size, self._routing_offset,
+         self._routing_size) = self.HEADER.unpack_from(self._map, 0)
+
+        if magic != self.MAGIC or major != self.VERSION_MAJOR or total_size > len(self._map):
+            self._map.close()
+            raise ValueError(f"{path} is not a version {self.VERSION_MAJOR} statistics segment")
+
+    def close(self):
+        """Unmap the segment"""
+        self._map.close()
+
+    def _sequence(self) -> int:
+        return struct.unpack_from('<Q', self._map, self.SEQUENCE_OFFSET)[0]
+
+    def _snapshot(self, offset: int, size: int) -> Tuple[bytes, int]:
+        """Copy a range that no update overlapped; returns it with the update time"""
+        while True:
+            begin = self._sequence()
+            if begin & 1:
+                time.sleep(0)
+                continue
+            data = self._map[offset:offset + size]
+            update_ns = struct.unpack_from('<Q', self._map, 32)[0]
+            if self._sequence() == begin:
+                return data, update_ns
+
+    def _table(self, offset: int, record_size: int, count: int,
+               fields: Tuple[str, ...]) -> List[Dict[str, int]]:
+        data, _ = self._snapshot(offset, record_size * count)
+        # Newer minor versions append fields; only decode the known ones
+        known = min(len(fields), record_size // 8)
+        record = struct.Struct(f'<{known}Q')
+        return [dict(zip(fields, record.unpack_from(data, i * record_size)))
+                for i in range(count)]
+
+    def update_time(self) -> float:
+        """Time of the last update in seconds since the epoch, 0 if none yet"""
+        return self._snapshot(0, 0)[1] / 1e9
+
+    def read_ports(self) -> List[Dict[str, int]]:
+        """Counters of every port, indexed by port ID"""
+        return self._table(self._port_offset, self._port_size, self.port_count, self.PORT_FIELDS)
+
+    def read_vlans(self) -> List[Dict[str, int]]:
+        """Counters of every VLAN, indexed by VLAN ID"""
+        return self._table(self._vlan_offset, self._vlan_size, self.vlan_count, self.VLAN_FIELDS)
+
+    def read_queues(self) -> List[List[Dict[str, int]]]:
+        """Egress queue counters, indexed by port ID and then queue"""
+        flat = self._table(self._queue_offset, self._queue_size,
+                           self.port_count * self.queues_per_port, self.QUEUE_FIELDS)
+        q = self.queues_per_port
+        return [flat[p * q:(p + 1) * q] for p in range(self.port_count)]
+
+    def read_routing(self) -> Dict[str, int]:
+        """Routing counters"""
+        return self._table(self._routing_offset, self._routing_size, 1, self.ROUTING_FIELDS)[0]
+
+
+class SharedHistoryReader:
+    """
+    Reads the counter history the simulator keeps in shared memory
+
+    The layout is documented in include/management/stats_history.h. The
+    simulator computes the rate, moving average and peak of every counter
+    when it takes a sample, so a rate or utilization query is one small
+    copy under the segment's sequence lock.
+    """
+
+    MAGIC = 0x53485753
+    VERSION_MAJOR = 2
+    OBJ_PORT, OBJ_VLAN, OBJ_QUEUE, OBJ_ROUTING, OBJ_INT = range(5)
+    OBJ_COUNT = 5
+    HEADER = struct.Struct(f'<IHHIIQQQQ{8 + 4 * OBJ_COUNT}I')
+    SEQUENCE_OFFSET = 24
+    RATE = struct.Struct('<3d')
+
+    # INT hops are sampled here but not kept in the statistics segment
+    INT_FIELDS = ('switch_id', 'egress_port', 'packets', 'latency_total_ns', 'latency_max_ns',
+                  'depth_total', 'depth_max')
+    FIELDS = (SharedStatsReader.PORT_FIELDS, SharedStatsReader.VLAN_FIELDS,
+              SharedStatsReader.QUEUE_FIELDS, SharedStatsReader.ROUTING_FIELDS, INT_FIELDS)
+
+    def __init__(self, name: str = '/switch_sim_history'):
+        """
+        Map a history segment read-only
+
+        Args:
+            name: Segment name as passed to the simulator's -H option
+
+        Raises:
+            OSError: If the segment does not exist
+            ValueError: If the segment has an unknown layout
+        """
+        path = os.path.join('/dev/shm', name.lstrip('/'))
+        fd = os.open(path, os.O_RDONLY)
+        try:
+            self._map = mmap.mmap(fd, 0, mmap.MAP_SHARED, mmap.PROT_READ)
+        finally:
+            os.close(fd)
+
+        fields = self.HEADER.unpack_from(self._map, 0)
+        magic, major, total_size = fields[0], fields[1], fields[5]
+        if magic != self.MAGIC or major != self.VERSION_MAJOR or total_size > len(self._map):
+            self._map.close()
+            raise ValueError(f"{path} is not a version {self.VERSION_MAJOR} history segment")
+
+        (self.interval_ms, self.depth, self._slots, _head, _samples, self.ewma_pct,
+         self._time_offset, self._speed_offset) = fields[9:17]
+        n = self.OBJ_COUNT
+        self.counts = fields[17:17 + n]
+        self._words = fields[17 + n:17 + 2 * n]
+        self._sample_offsets = fields[17 + 2 * n:17 + 3 * n]
+        self._rate_offsets = fields[17 + 3 * n:17 + 4 * n]
+
+    def close(self):
+        """Unmap the segment"""
+        self._map.close()
+
+    def _sequence(self) -> int:
+        return struct.unpack_from('<Q', self._map, self.SEQUENCE_OFFSET)[0]
+
+    def _snapshot(self, ranges: List[Tuple[int, int]]) -> Tuple[List[bytes], int, int]:
+        """Copy ranges that no sample overlapped; returns them with head and samples"""
+        while True:
+            begin = self._sequence()
+            if begin & 1:
+                time.sleep(0)
+                continue
+            head, samples = struct.unpack_from('<II', self._map, 60)
+            data = [self._map[offset:offset + size] for offset, size in ranges]
+            if self._sequence() == begin:
+                return data, head, samples
+
+    def _check(self, obj: int, index: int):
+        if not 0 <= index < self.counts[obj]:
+            raise IndexError(f"object {index} of type {obj} is not in the history")
+
+    def rates(self, obj: int, index: int) -> Dict[str, Dict[str, float]]:
+        """Rate, moving average and peak per second of every counter of one object"""
+        self._check(obj, index)
+        words = self._words[obj]
+        size = self.RATE.size
+        (data,), _, _ = self._snapshot([(self._rate_offsets[obj] + index * words * size, words * size)])
+        names = self.FIELDS[obj]
+        return {names[c] if c < len(names) else str(c):
+                dict(zip(('rate', 'ewma', 'peak'), self.RATE.unpack_from(data, c * size)))
+                for c in range(words)}
+
+    def samples(self, obj: int, index: int, limit: Optional[int] = None) -> List[Dict[str, int]]:
+        """Newest samples of one object, oldest first, each with its 'time_ns'"""
+        self._check(obj, index)
+        words = self._words[obj]
+        block = self._slots * words * 8
+        (values, times), head, samples = self._snapshot([
+            (self._sample_offsets[obj] + index * block, block),
+            (self._time_offset, self._slots * 8)])
+        count = samples if limit is None else min(samples, limit)
+        names = self.FIELDS[obj]
+        known = min(len(names), words)
+        record = struct.Struct(f'<{known}Q')
+        result = []
+        for i in range(count):
+            slot = (head + self._slots - (count - 1 - i)) % self._slots
+            entry = dict(zip(names, record.unpack_from(values, slot * words * 8)))
+            entry['time_ns'] = struct.unpack_from('<Q', times, slot * 8)[0]
+            result.append(entry)
+        return result
+
+    def port_utilization(self, port_id: int) -> Dict[str, Any]:
+        """Load of a port from the byte rates of the last sample and its speed"""
+        self._check(self.OBJ_PORT, port_id)
+        rates = self.rates(self.OBJ_PORT, port_id)
+        speed_mbps = struct.unpack_from('<Q', self._map, self._speed_offset + port_id * 8)[0]
+        capacity = speed_mbps * 1_000_000
+        rx_bps = rates['rx_bytes']['rate'] * 8
+        tx_bps = rates['tx_bytes']['rate'] * 8
+        rx_utilization = rx_bps * 100 / capacity if capacity else 0.0
+        tx_utilization = tx_bps * 100 / capacity if capacity else 0.0
+        return {
+            "port_id": port_id,
+            "time_period_seconds": self.interval_ms / 1000,
+            "speed_mbps": speed_mbps,
+            "rx_rate_bps": rx_bps,
+            "tx_rate_bps": tx_bps,
+            "rx_rate_mbps": rx_bps / 1_000_000,
+            "tx_rate_mbps": tx_bps / 1_000_000,
+            "rx_avg_bps": rates['rx_bytes']['ewma'] * 8,
+            "tx_avg_bps": rates['tx_bytes']['ewma'] * 8,
+            "rx_peak_bps": rates['rx_bytes']['peak'] * 8,
+            "tx_peak_bps": rates['tx_bytes']['peak'] * 8,
+            "rx_utilization_percent": rx_utilization,
+            "tx_utilization_percent": tx_utilization,
+            "total_utilization_percent": (rx_utilization + tx_utilization) / 2
+        }
+
+
 class StatsCollector:
     """Collects and stores statistics from the switch"""
     
-    def __init__(self, controller: 'SwitchController'):
+    def __init__(self, controller: 'SwitchController', shm_name: Optional[str] = None,
+                 history_name: Optional[str] = None):
         """
         Initialize the stats collector
         
         Args:
             controller: The switch controller instance
+            shm_name: Statistics segment to read instead of polling the
+                controller port by port, if the simulator exports one
+            history_name: Counter history segment kept by the simulator (-H),
+                used instead of the history filled here by polling
         """
         self.controller = controller
+        self.shared_stats = None
+        if shm_name:
+            try:
+                self.shared_stats = SharedStatsReader(shm_name)
+            except (OSError, ValueError) as e:
+                logger.warning(f"Shared statistics not available, polling the controller: {e}")
+        self.shared_history = None
+        if history_name:
+            try:
+                self.shared_history = SharedHistoryReader(history_name)
+            except (OSError, ValueError) as e:
+                logger.warning(f"Shared counter history not available, keeping it here: {e}")
         self.stats_history = {
             'ports': {},
             'vlans': {},
@@ -98,15 +361,25 @@ class StatsCollector:
                 logger.error(f"Error in stats collection: {e}")
                 time.sleep(1)  # Shorter sleep on error
     
+    def _port_stats_snapshot(self) -> Dict[int, Dict[str, Any]]:
+        """Current statistics of every port"""
+        if self.shared_stats:
+            interfaces = {i.port_id for i in self.controller.get_all_interfaces()}
+            return {port_id: stats for port_id, stats in enumerate(self.shared_stats.read_ports())
+                    if port_id in interfaces}
+        
+        # One bulk call for all ports instead of one call per port
+        port_ids = [interface.port_id for interface in self.controller.get_all_interfaces()]
+        counters = self.controller.read_port_counters_bulk(port_ids)
+        return {port_id: {name: int(column[i]) for name, column in counters.items()}
+                for i, port_id in enumerate(port_ids)}
+    
     def _collect_stats(self):
         """Collect current statistics from the switch"""
         timestamp = datetime.now().isoformat()
         
         # Collect port statistics
-        for interface in self.controller.get_all_interfaces():
-            port_id = interface.port_id
-            stats = interface.get_statistics()
-            
+        for port_id, stats in self._port_stats_snapshot().items():
             if port_id not in self.stats_history['ports']:
                 self.stats_history['ports'][port_id] = []
             
@@ -120,7 +393,18 @@ class StatsCollector:
             if len(self.stats_history['ports'][port_id]) > 100:
                 self.stats_history['ports'][port_id].pop(0)
         
-        # Here we would also collect VLAN, MAC table and routing statistics
+        # VLAN counters are only available from the shared segment
+        if self.shared_stats:
+            for vlan_id, stats in enumerate(self.shared_stats.read_vlans()):
+                if not stats['rx_packets'] and not stats['tx_packets']:
+                    continue
+                stats['timestamp'] = timestamp
+                history = self.stats_history['vlans'].setdefault(vlan_id, [])
+                history.append(stats)
+                if len(history) > 100:
+                    history.pop(0)
+        
+        # Here we would also collect MAC table and routing statistics
         # For now, this is a placeholder
     
     def get_port_stats_history(self, port_id: int, limit: int = 10) -> List[Dict[str, Any]]:
@@ -134,6 +418,15 @@ class StatsCollector:
         Returns:
             List of statistics dictionaries
         """
+        if self.shared_history:
+            try:
+                history = self.shared_history.samples(SharedHistoryReader.OBJ_PORT, port_id, limit)
+            except IndexError:
+                return []
+            for entry in history:
+                entry['timestamp'] = datetime.fromtimestamp(entry['time_ns'] / 1e9).isoformat()
+            return history
+        
         if port_id not in self.stats_history['ports']:
             return []
         
@@ -162,15 +455,18 @@ class StatsCollector:
 class StatsViewer:
     """Provides methods for viewing and analyzing switch statistics"""
     
-    def __init__(self, controller: 'SwitchController'):
+    def __init__(self, controller: 'SwitchController', shm_name: Optional[str] = None,
+                 history_name: Optional[str] = None):
         """
         Initialize the stats viewer
         
         Args:
             controller: The switch controller instance
+            shm_name: Statistics segment exported by the simulator (-s), if any
+            history_name: Counter history segment of the simulator (-H), if any
         """
         self.controller = controller
-        self.collector = StatsCollector(controller)
+        self.collector = StatsCollector(controller, shm_name, history_name)
     
     def start_collection(self, interval: int = 5) -> bool:
         """
@@ -223,6 +519,13 @@ class StatsViewer:
         Returns:
             Dictionary with utilization statistics
         """
+        # The simulator keeps the rates itself; time_period is its sampling interval then
+        if self.collector.shared_history:
+            try:
+                return self.collector.shared_history.port_utilization(port_id)
+            except IndexError:
+                return {"error": f"Port {port_id} is not in the counter history"}
+        
         # Get historical data for the port
         stats_history = self.collector.get_port_stats_history(port_id)
         
@@ -277,12 +580,8 @@ class StatsViewer:
         Returns:
             List of MAC table entries
         """
-        # This would call into the controller to get MAC table
-        # For now, return a placeholder
-        return [
-            {"mac_address": "00:11:22:33:44:55", "vlan": 1, "port": 1, "type": "dynamic"},
-            {"mac_address": "66:77:88:99:AA:BB", "vlan": 1, "port": 2, "type": "dynamic"}
-        ]
+        # One packed export call; the table is copied without blocking forwarding
+        return self.controller.get_mac_table()
     
     def get_vlan_statistics(self) -> Dict[int, Dict[str, Any]]:
         """
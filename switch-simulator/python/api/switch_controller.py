@@ -6,11 +6,21 @@ including port configuration, VLAN setup, and routing table management.
 """
 
 import os
+import asyncio
 import sys
 import ctypes
+import socket
+import struct
 import logging
 from enum import Enum, auto
-from typing import Dict, List, Optional, Tuple, Union, Any
+from typing import Dict, Iterable, Iterator, List, Optional, Sequence, Tuple, Union, Any
+
+try:
+    import numpy as np
+except ImportError:  # Bulk calls fall back to memoryviews
+    np = None
+
+from .events import ALL_EVENT_KINDS, EventFeedReader, EventSubscription, configure_event_feed_signatures
 
 # Add the parent directory to sys.path to access C library
 sys.path.append(os.path.join(os.path.dirname(__file__), '../..'))
@@ -22,6 +32,110 @@ logging.basicConfig(
 )
 logger = logging.getLogger(__name__)
 
+# Packed MAC table export (mac_table_export_header_t / mac_table_export_record_t)
+MAC_TABLE_EXPORT_MAGIC = 0x5443414D
+MAC_TABLE_EXPORT_VERSION = 1
+_MAC_EXPORT_HEADER = struct.Struct('=IHHII')
+_MAC_EXPORT_RECORD = struct.Struct('=6sHHBBI')
+_MAC_ENTRY_TYPES = {0: "dynamic", 1: "static", 2: "management"}
+_STATUS_OUT_OF_BOUNDS = -16
+_TABLE_CURSOR_END = 0xFFFFFFFFFFFFFFFF
+
+# Bulk VLAN provisioning bitmaps (vlan_port_bitmap_t / VLAN_ID_WORDS words)
+_VLAN_PORT_WORDS = 4      # (CONFIG_MAX_PORTS + 63) / 64
+_VLAN_ID_WORDS = 64       # MAX_VLANS / 64
+_VLAN_MEMBER_TAGGED = 0
+_VLAN_MEMBER_UNTAGGED = 1
+_VlanPortBitmap = ctypes.c_uint64 * _VLAN_PORT_WORDS
+_VlanIdBitmap = ctypes.c_uint64 * _VLAN_ID_WORDS
+
+
+# Column-array bulk API (include/management/bulk_api.h)
+_BULK_ADDR_LEN = 16
+_PORT_COUNTER_NAMES = (
+    "rx_packets", "tx_packets", "rx_bytes", "tx_bytes", "rx_errors", "tx_errors",
+    "rx_dropped", "tx_dropped", "rx_unicast", "tx_unicast", "rx_broadcast", "tx_broadcast",
+    "rx_multicast", "tx_multicast", "collisions",
+)
+_VLAN_COUNTER_NAMES = ("rx_packets", "rx_bytes", "tx_packets", "tx_bytes")
+
+
+class _BulkRouteColumns(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_void_p) for name in
+                ("prefix", "next_hop", "is_ipv6", "prefix_len", "interface", "metric", "source")]
+
+
+class _BulkMacColumns(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_void_p) for name in
+                ("mac", "vlan_id", "port_id", "type", "age_timestamp")]
+
+
+class _BulkVlanMemberColumns(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_void_p) for name in ("vlan_id", "port_id", "tagged")]
+
+
+_COLUMN_FORMATS = {
+    ctypes.c_uint8: 'B', ctypes.c_uint16: 'H', ctypes.c_uint32: 'I',
+    ctypes.c_uint64: 'Q', ctypes.c_int32: 'i',
+}
+
+
+def _column(ctype, count, width=1):
+    """
+    New contiguous column of count rows of width items
+
+    Returns (buffer, view). The view shares the buffer: a numpy array of
+    shape (count,) or (count, width) when numpy is available, otherwise
+    a flat memoryview of count * width items.
+    """
+    buf = (ctype * max(count * width, 1))()
+    if np is not None:
+        view = np.ctypeslib.as_array(buf)[:count * width]
+        return buf, view.reshape(count, width) if width > 1 else view
+    return buf, memoryview(buf).cast('B').cast(_COLUMN_FORMATS[ctype])[:count * width]
+
+
+def _input_column(values, ctype):
+    """
+    Address of a column given by the caller, and the object keeping it alive
+
+    Contiguous numpy arrays of the right dtype are passed without a copy;
+    anything else is packed into a new ctypes array.
+    """
+    if np is not None and isinstance(values, np.ndarray):
+        array = np.ascontiguousarray(values, dtype=np.dtype(ctype))
+        return array.ctypes.data, array
+    buf = (ctype * max(len(values), 1))(*values)
+    return ctypes.addressof(buf), buf
+
+
+def _pack_addresses(addresses):
+    """Pack address strings into a 16-byte-per-row column; returns (buffer, is_ipv6 list)"""
+    buf = (ctypes.c_uint8 * (max(len(addresses), 1) * _BULK_ADDR_LEN))()
+    is_ipv6 = []
+    for row, address in enumerate(addresses):
+        v6 = ':' in address
+        packed = socket.inet_pton(socket.AF_INET6 if v6 else socket.AF_INET, address)
+        ctypes.memmove(ctypes.addressof(buf) + row * _BULK_ADDR_LEN, packed, len(packed))
+        is_ipv6.append(int(v6))
+    return buf, is_ipv6
+
+
+def _unpack_address(row_bytes, is_ipv6):
+    """Address string of one row of an address column"""
+    data = bytes(row_bytes)
+    return socket.inet_ntop(socket.AF_INET6, data) if is_ipv6 else socket.inet_ntop(socket.AF_INET, data[:4])
+
+
+def _pack_bitmap(ids, words):
+    """Pack integer IDs into a ctypes array of 64-bit words"""
+    bitmap = (ctypes.c_uint64 * words)()
+    for i in ids:
+        if i < 0 or i >= words * 64:
+            raise ValueError(f"ID {i} does not fit in a {words * 64}-bit bitmap")
+        bitmap[i // 64] |= 1 << (i % 64)
+    return bitmap
+
 # Load the C library
 try:
     _lib_path = os.path.join(os.path.dirname(__file__), '../../build/libswitch_simulator.so')
@@ -143,6 +257,7 @@ class SwitchController:
         self.config = config or SwitchConfig()
         self._interfaces = {}
         self._initialized = False
+        self._event_reader = None
         
         # Define C function signatures
         self._configure_function_signatures()
@@ -174,6 +289,50 @@ class SwitchController:
         ]
         self._switch_lib.add_port_to_vlan.restype = ctypes.c_int
         
+        # Bulk VLAN provisioning
+        self._switch_lib.vlan_create_range.argtypes = [ctypes.c_uint16, ctypes.c_uint16]
+        self._switch_lib.vlan_create_range.restype = ctypes.c_int
+        
+        self._switch_lib.vlan_add_ports_bitmap.argtypes = [
+            ctypes.c_uint16, ctypes.c_uint16, ctypes.POINTER(_VlanPortBitmap), ctypes.c_int
+        ]
+        self._switch_lib.vlan_add_ports_bitmap.restype = ctypes.c_int
+        
+        self._switch_lib.vlan_set_trunk_allowed_bitmap.argtypes = [
+            ctypes.c_uint16, ctypes.POINTER(_VlanIdBitmap)
+        ]
+        self._switch_lib.vlan_set_trunk_allowed_bitmap.restype = ctypes.c_int
+        
+        # MAC table functions
+        self._switch_lib.mac_table_export.argtypes = [
+            ctypes.c_void_p, ctypes.c_uint32, ctypes.POINTER(ctypes.c_uint32)
+        ]
+        self._switch_lib.mac_table_export.restype = ctypes.c_int
+        
+        # Column-array bulk functions
+        for name, columns in (("routes", _BulkRouteColumns), ("mac_entries", _BulkMacColumns),
+                              ("vlan_members", _BulkVlanMemberColumns)):
+            update = getattr(self._switch_lib, f"bulk_update_{name}")
+            update.argtypes = [ctypes.POINTER(columns), ctypes.c_uint32, ctypes.c_bool, ctypes.c_void_p]
+            update.restype = ctypes.c_int
+            read = getattr(self._switch_lib, f"bulk_read_{name}")
+            read.argtypes = [ctypes.POINTER(columns), ctypes.c_uint32, ctypes.POINTER(ctypes.c_uint32)]
+            read.restype = ctypes.c_int
+        
+        for name, columns in (("routes", _BulkRouteColumns), ("mac_entries", _BulkMacColumns)):
+            read = getattr(self._switch_lib, f"bulk_read_{name}_page")
+            read.argtypes = [ctypes.POINTER(columns), ctypes.c_uint32, ctypes.POINTER(ctypes.c_uint64),
+                             ctypes.POINTER(ctypes.c_uint32)]
+            read.restype = ctypes.c_int
+        
+        for name in ("bulk_read_port_counters", "bulk_read_vlan_counters"):
+            read = getattr(self._switch_lib, name)
+            read.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_void_p, ctypes.c_void_p]
+            read.restype = ctypes.c_int
+        
+        # Event feed functions
+        configure_event_feed_signatures(self._switch_lib)
+        
         # Other functions will be added as needed
     
     def initialize(self) -> SwitchStatus:
@@ -346,6 +505,96 @@ class SwitchController:
         
         return status
     
+    def create_vlan_range(self, first_vlan: int, last_vlan: int) -> SwitchStatus:
+        """Create VLANs first_vlan..last_vlan (inclusive) in one call"""
+        if not self._initialized:
+            self.initialize()
+        
+        result = self._switch_lib.vlan_create_range(first_vlan, last_vlan)
+        status = SwitchStatus.OK if result == 0 else SwitchStatus.ERROR
+        
+        if status == SwitchStatus.OK:
+            logger.info(f"Created VLANs {first_vlan}-{last_vlan}")
+        else:
+            logger.error(f"Failed to create VLANs {first_vlan}-{last_vlan}: error code {result}")
+        
+        return status
+    
+    def add_ports_to_vlan_range(self, port_ids: List[int], first_vlan: int, last_vlan: int,
+                                tagged: bool = True) -> SwitchStatus:
+        """Add ports to every VLAN in first_vlan..last_vlan (inclusive) in one call"""
+        if not self._initialized:
+            self.initialize()
+        
+        ports = _pack_bitmap(port_ids, _VLAN_PORT_WORDS)
+        member_type = _VLAN_MEMBER_TAGGED if tagged else _VLAN_MEMBER_UNTAGGED
+        result = self._switch_lib.vlan_add_ports_bitmap(first_vlan, last_vlan, ctypes.byref(ports), member_type)
+        status = SwitchStatus.OK if result == 0 else SwitchStatus.ERROR
+        
+        if status == SwitchStatus.OK:
+            logger.info(f"Added {len(port_ids)} ports to VLANs {first_vlan}-{last_vlan} "
+                        f"({'tagged' if tagged else 'untagged'})")
+        else:
+            logger.error(f"Failed to add ports to VLANs {first_vlan}-{last_vlan}: error code {result}")
+        
+        return status
+    
+    def set_trunk_allowed_vlans(self, port_id: int, vlan_ids: List[int]) -> SwitchStatus:
+        """Replace the set of VLANs allowed on a trunk port"""
+        if not self._initialized:
+            self.initialize()
+        
+        vlans = _pack_bitmap(vlan_ids, _VLAN_ID_WORDS)
+        result = self._switch_lib.vlan_set_trunk_allowed_bitmap(port_id, ctypes.byref(vlans))
+        status = SwitchStatus.OK if result == 0 else SwitchStatus.ERROR
+        
+        if status == SwitchStatus.OK:
+            logger.info(f"Set {len(vlan_ids)} allowed VLANs on trunk port {port_id}")
+        else:
+            logger.error(f"Failed to set allowed VLANs on port {port_id}: error code {result}")
+        
+        return status
+    
+    # MAC table methods
+    def get_mac_table(self) -> List[Dict[str, Any]]:
+        """Get the current MAC address table from a packed export"""
+        if not self._initialized:
+            self.initialize()
+        
+        size = ctypes.c_uint32(0)
+        buf = None
+        result = _STATUS_OUT_OF_BOUNDS
+        # The first call reports the size needed; retry if the table grew
+        for _ in range(4):
+            needed = size.value + size.value // 8
+            buf = ctypes.create_string_buffer(max(needed, _MAC_EXPORT_HEADER.size))
+            result = self._switch_lib.mac_table_export(buf, len(buf), ctypes.byref(size))
+            if result != _STATUS_OUT_OF_BOUNDS:
+                break
+        
+        if result != 0:
+            logger.error(f"Failed to export MAC table: error code {result}")
+            return []
+        
+        data = buf.raw[:size.value]
+        magic, version, record_size, count, _ = _MAC_EXPORT_HEADER.unpack_from(data)
+        if (magic != MAC_TABLE_EXPORT_MAGIC or version != MAC_TABLE_EXPORT_VERSION or
+                record_size != _MAC_EXPORT_RECORD.size):
+            logger.error("Unexpected MAC table export format")
+            return []
+        
+        records = data[_MAC_EXPORT_HEADER.size:_MAC_EXPORT_HEADER.size + count * record_size]
+        return [
+            {
+                "mac_address": ":".join(f"{b:02X}" for b in mac),
+                "vlan": vlan,
+                "port": port,
+                "type": _MAC_ENTRY_TYPES.get(entry_type, "unknown"),
+                "age_timestamp": age
+            }
+            for mac, vlan, port, entry_type, _, age in _MAC_EXPORT_RECORD.iter_unpack(records)
+        ]
+    
     # L3 routing methods
     def add_static_route(self, network: str, netmask: str, next_hop: str, 
                          interface: Optional[int] = None) -> SwitchStatus:
@@ -386,3 +635,290 @@ class SwitchController:
                 "metric": 0
             }
         ]
+    
+    # Column-array bulk methods
+    #
+    # Each method is a single call into the C library for the whole batch.
+    # Results are columns over one buffer per field: numpy arrays when numpy
+    # is installed, memoryviews otherwise, in both cases without a copy.
+    def _bulk_update(self, update, columns, count: int, remove: bool, what: str) -> Sequence[int]:
+        """Run a bulk update; returns the status of each row"""
+        statuses, statuses_view = _column(ctypes.c_int32, count)
+        result = update(ctypes.byref(columns), count, remove, statuses)
+        if result != 0:
+            failed = sum(1 for status in statuses_view if status != 0)
+            logger.error(f"Bulk {what}: {failed} of {count} rows failed, last error code {result}")
+        else:
+            logger.info(f"Bulk {what}: {count} rows")
+        return statuses_view
+    
+    def _bulk_read(self, read, structure, fields, what: str, capacity: int = 1024) -> Dict[str, Any]:
+        """
+        Run a bulk read into new columns; fields maps a field name to (ctype, width)
+        
+        The table may grow between the call that reports the rows needed and
+        the retry, so the retry leaves some headroom.
+        """
+        count = ctypes.c_uint32(0)
+        result = _STATUS_OUT_OF_BOUNDS
+        for _ in range(4):
+            buffers = {name: _column(ctype, capacity, width) for name, (ctype, width) in fields.items()}
+            columns = structure(**{name: ctypes.addressof(buf) for name, (buf, _) in buffers.items()})
+            result = read(ctypes.byref(columns), capacity, ctypes.byref(count))
+            if result != _STATUS_OUT_OF_BOUNDS:
+                break
+            capacity = count.value + count.value // 8 + 1
+        
+        if result != 0:
+            logger.error(f"Failed to read {what}: error code {result}")
+            return {name: view[:0] for name, (_, view) in buffers.items()}
+        
+        rows = count.value
+        return {name: view[:rows * (width if np is None else 1)]
+                for (name, (_, view)), (_, width) in zip(buffers.items(), fields.values())}
+    
+    def _bulk_read_pages(self, read, structure, fields, what: str,
+                         page_rows: int) -> Iterator[Dict[str, Any]]:
+        """
+        Run a paged bulk read, yielding new columns of up to page_rows rows per page
+        
+        The table is not copied as a whole, so memory stays at a page however
+        large the table; entries changed during the read may or may not be seen.
+        """
+        cursor = ctypes.c_uint64(0)
+        count = ctypes.c_uint32(0)
+        while cursor.value != _TABLE_CURSOR_END:
+            buffers = {name: _column(ctype, page_rows, width) for name, (ctype, width) in fields.items()}
+            columns = structure(**{name: ctypes.addressof(buf) for name, (buf, _) in buffers.items()})
+            result = read(ctypes.byref(columns), page_rows, ctypes.byref(cursor), ctypes.byref(count))
+            if result != 0:
+                logger.error(f"Failed to read {what}: error code {result}")
+                return
+            
+            rows = count.value
+            if rows > 0:
+                yield {name: view[:rows * (width if np is None else 1)]
+                       for (name, (_, view)), (_, width) in zip(buffers.items(), fields.values())}
+    
+    def update_routes_bulk(self, prefixes: Sequence[str], next_hops: Optional[Sequence[str]] = None,
+                           interfaces=None, metrics=None, remove: bool = False) -> Sequence[int]:
+        """
+        Add or remove routes given as "network/length" strings in one routing table batch
+        
+        next_hops, interfaces and metrics are optional columns of the same length;
+        interfaces and metrics may be numpy arrays. Returns the status of each row.
+        """
+        if not self._initialized:
+            self.initialize()
+        
+        count = len(prefixes)
+        networks, lengths = zip(*(prefix.split('/') for prefix in prefixes)) if count else ((), ())
+        prefix_buf, is_ipv6 = _pack_addresses(networks)
+        length_buf = (ctypes.c_uint8 * max(count, 1))(*(int(length) for length in lengths))
+        family_buf = (ctypes.c_uint8 * max(count, 1))(*is_ipv6)
+        keep = [prefix_buf, length_buf, family_buf]
+        columns = _BulkRouteColumns(prefix=ctypes.addressof(prefix_buf),
+                                    is_ipv6=ctypes.addressof(family_buf),
+                                    prefix_len=ctypes.addressof(length_buf))
+        if next_hops is not None:
+            next_hop_buf, _ = _pack_addresses(next_hops)
+            keep.append(next_hop_buf)
+            columns.next_hop = ctypes.addressof(next_hop_buf)
+        if interfaces is not None:
+            columns.interface, interface_buf = _input_column(interfaces, ctypes.c_uint16)
+            keep.append(interface_buf)
+        if metrics is not None:
+            columns.metric, metric_buf = _input_column(metrics, ctypes.c_uint16)
+            keep.append(metric_buf)
+        
+        return self._bulk_update(self._switch_lib.bulk_update_routes, columns, count, remove,
+                                 "route removal" if remove else "route update")
+    
+    def read_routes_bulk(self) -> Dict[str, Any]:
+        """
+        Read the routing table as columns
+        
+        prefix and next_hop hold 16 bytes per row (see routes_from_columns()).
+        """
+        if not self._initialized:
+            self.initialize()
+        
+        fields = {
+            "prefix": (ctypes.c_uint8, _BULK_ADDR_LEN), "next_hop": (ctypes.c_uint8, _BULK_ADDR_LEN),
+            "is_ipv6": (ctypes.c_uint8, 1), "prefix_len": (ctypes.c_uint8, 1),
+            "interface": (ctypes.c_uint16, 1), "metric": (ctypes.c_uint16, 1), "source": (ctypes.c_uint8, 1),
+        }
+        return self._bulk_read(self._switch_lib.bulk_read_routes, _BulkRouteColumns, fields,
+                               "routing table")
+    
+    def iter_routes_bulk(self, page_rows: int = 4096) -> Iterator[Dict[str, Any]]:
+        """
+        Read the routing table as columns, one page of up to page_rows routes at a time
+        
+        Each page is a dictionary as from read_routes_bulk(); the routing lock
+        is held for a few hundred routes at a time.
+        """
+        if not self._initialized:
+            self.initialize()
+        
+        fields = {
+            "prefix": (ctypes.c_uint8, _BULK_ADDR_LEN), "next_hop": (ctypes.c_uint8, _BULK_ADDR_LEN),
+            "is_ipv6": (ctypes.c_uint8, 1), "prefix_len": (ctypes.c_uint8, 1),
+            "interface": (ctypes.c_uint16, 1), "metric": (ctypes.c_uint16, 1), "source": (ctypes.c_uint8, 1),
+        }
+        return self._bulk_read_pages(self._switch_lib.bulk_read_routes_page, _BulkRouteColumns, fields,
+                                     "routing table", page_rows)
+    
+    @staticmethod
+    def routes_from_columns(columns: Dict[str, Any]) -> List[Dict[str, Any]]:
+        """Convert route columns to one dictionary per route"""
+        def address(column, row, is_ipv6):
+            if np is not None:
+                return _unpack_address(column[row], is_ipv6)
+            return _unpack_address(column[row * _BULK_ADDR_LEN:(row + 1) * _BULK_ADDR_LEN], is_ipv6)
+        
+        return [
+            {
+                "network": address(columns["prefix"], row, columns["is_ipv6"][row]),
+                "prefix_len": int(columns["prefix_len"][row]),
+                "next_hop": address(columns["next_hop"], row, columns["is_ipv6"][row]),
+                "interface": int(columns["interface"][row]),
+                "metric": int(columns["metric"][row]),
+                "source": int(columns["source"][row]),
+            }
+            for row in range(len(columns["is_ipv6"]))
+        ]
+    
+    def update_static_macs_bulk(self, macs: Sequence[str], vlan_ids, port_ids=None,
+                                remove: bool = False) -> Sequence[int]:
+        """
+        Add or delete static MAC entries in one call
+        
+        vlan_ids and port_ids may be numpy arrays; port_ids is not needed to delete.
+        Returns the status of each row.
+        """
+        if not self._initialized:
+            self.initialize()
+        
+        count = len(macs)
+        mac_buf = (ctypes.c_uint8 * (max(count, 1) * 6))()
+        for row, mac in enumerate(macs):
+            ctypes.memmove(ctypes.addressof(mac_buf) + row * 6, bytes.fromhex(mac.replace(':', '')), 6)
+        columns = _BulkMacColumns(mac=ctypes.addressof(mac_buf))
+        columns.vlan_id, vlan_buf = _input_column(vlan_ids, ctypes.c_uint16)
+        keep = [mac_buf, vlan_buf]
+        if port_ids is not None:
+            columns.port_id, port_buf = _input_column(port_ids, ctypes.c_uint16)
+            keep.append(port_buf)
+        
+        return self._bulk_update(self._switch_lib.bulk_update_mac_entries, columns, count, remove,
+                                 "static MAC removal" if remove else "static MAC update")
+    
+    def read_mac_table_columns(self) -> Dict[str, Any]:
+        """Read the MAC table as columns; mac holds 6 bytes per row"""
+        if not self._initialized:
+            self.initialize()
+        
+        fields = {
+            "mac": (ctypes.c_uint8, 6), "vlan_id": (ctypes.c_uint16, 1), "port_id": (ctypes.c_uint16, 1),
+            "type": (ctypes.c_uint8, 1), "age_timestamp": (ctypes.c_uint32, 1),
+        }
+        return self._bulk_read(self._switch_lib.bulk_read_mac_entries, _BulkMacColumns, fields,
+                               "MAC table")
+    
+    def iter_mac_table_columns(self, page_rows: int = 4096) -> Iterator[Dict[str, Any]]:
+        """
+        Read the MAC table as columns, one page of up to page_rows entries at a time
+        
+        Pages come in table order rather than sorted, read without a snapshot.
+        """
+        if not self._initialized:
+            self.initialize()
+        
+        fields = {
+            "mac": (ctypes.c_uint8, 6), "vlan_id": (ctypes.c_uint16, 1), "port_id": (ctypes.c_uint16, 1),
+            "type": (ctypes.c_uint8, 1), "age_timestamp": (ctypes.c_uint32, 1),
+        }
+        return self._bulk_read_pages(self._switch_lib.bulk_read_mac_entries_page, _BulkMacColumns, fields,
+                                     "MAC table", page_rows)
+    
+    def update_vlan_members_bulk(self, vlan_ids, port_ids, tagged=None,
+                                 remove: bool = False) -> Sequence[int]:
+        """
+        Add or remove VLAN memberships, one row per (VLAN, port), in one call
+        
+        All columns may be numpy arrays; rows without a tagged column are untagged.
+        Returns the status of each row.
+        """
+        if not self._initialized:
+            self.initialize()
+        
+        columns = _BulkVlanMemberColumns()
+        columns.vlan_id, vlan_buf = _input_column(vlan_ids, ctypes.c_uint16)
+        columns.port_id, port_buf = _input_column(port_ids, ctypes.c_uint16)
+        keep = [vlan_buf, port_buf]
+        if tagged is not None:
+            columns.tagged, tagged_buf = _input_column(tagged, ctypes.c_uint8)
+            keep.append(tagged_buf)
+        
+        return self._bulk_update(self._switch_lib.bulk_update_vlan_members, columns, len(vlan_ids),
+                                 remove, "VLAN member removal" if remove else "VLAN member update")
+    
+    def read_vlan_members_bulk(self) -> Dict[str, Any]:
+        """Read the memberships of every active VLAN as columns"""
+        if not self._initialized:
+            self.initialize()
+        
+        fields = {"vlan_id": (ctypes.c_uint16, 1), "port_id": (ctypes.c_uint16, 1), "tagged": (ctypes.c_uint8, 1)}
+        return self._bulk_read(self._switch_lib.bulk_read_vlan_members, _BulkVlanMemberColumns, fields,
+                               "VLAN members")
+    
+    def _read_counters(self, read, ids, names, what: str) -> Dict[str, Any]:
+        """Read a counter matrix; returns counter name -> column indexed like ids"""
+        count = len(ids)
+        id_addr, id_buf = _input_column(ids, ctypes.c_uint16)
+        matrix, matrix_view = _column(ctypes.c_uint64, len(names) * count)
+        result = read(id_addr, count, matrix, None)
+        if result != 0:
+            logger.warning(f"Failed to read some {what} counters: error code {result}")
+        return {name: matrix_view[row * count:(row + 1) * count] for row, name in enumerate(names)}
+    
+    def read_port_counters_bulk(self, port_ids=None) -> Dict[str, Any]:
+        """
+        Read the counters of many ports in one call
+        
+        Returns counter name -> column with one entry per port of port_ids
+        (every port when None). Ports that cannot be read report zeros.
+        """
+        if not self._initialized:
+            self.initialize()
+        
+        if port_ids is None:
+            port_ids = list(self._interfaces)
+        return self._read_counters(self._switch_lib.bulk_read_port_counters, port_ids,
+                                   _PORT_COUNTER_NAMES, "port")
+    
+    def read_vlan_counters_bulk(self, vlan_ids) -> Dict[str, Any]:
+        """Read the counters of many VLANs in one call; same layout as read_port_counters_bulk()"""
+        if not self._initialized:
+            self.initialize()
+        
+        return self._read_counters(self._switch_lib.bulk_read_vlan_counters, vlan_ids,
+                                   _VLAN_COUNTER_NAMES, "VLAN")
+    
+    # Event subscriptions
+    def subscribe_events(self, kinds: Optional[Iterable[str]] = None,
+                         loop: Optional[asyncio.AbstractEventLoop] = None) -> EventSubscription:
+        """
+        Subscribe to simulator events from an asyncio loop
+        
+        kinds is a set of names from events.EVENT_KINDS, every kind when None.
+        Events are pushed through an eventfd watched by the loop, so waiting
+        for one takes no polling. Call from the loop, or pass it as loop.
+        """
+        if not self._initialized:
+            self.initialize()
+        
+        if self._event_reader is None:
+            self._event_reader = EventFeedReader(self._switch_lib)
+        return self._event_reader.add(ALL_EVENT_KINDS if kinds is None else kinds, loop)
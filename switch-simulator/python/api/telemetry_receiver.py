@@ -0,0 +1,214 @@
+"""
+Telemetry Receiver for Switch Simulator
+
+This module receives the streaming telemetry the simulator pushes over UDP
+(see include/management/telemetry.h for the wire format) and keeps the
+current value of every counter from the keyframes and deltas.
+"""
+
+import socket
+import struct
+import logging
+from typing import Dict, List, Optional, Tuple, Any
+
+logger = logging.getLogger(__name__)
+
+MAGIC = 0x4d545753
+VERSION = 1
+FLAG_KEYFRAME = 0x01
+FLAG_END = 0x02
+
+HEADER = struct.Struct('<IBBHIIQ')
+
+# Object types and counter names, numbered as in stats_export.h
+OBJECT_TYPES = ('port', 'vlan', 'queue', 'routing', 'int')
+COUNTER_NAMES = {
+    'port': ('rx_packets', 'tx_packets', 'rx_bytes', 'tx_bytes',
+             'rx_errors', 'tx_errors', 'rx_drops', 'tx_drops',
+             'rx_unicast', 'tx_unicast', 'rx_broadcast', 'tx_broadcast',
+             'rx_multicast', 'tx_multicast', 'collisions', 'last_clear'),
+    'vlan': ('rx_packets', 'tx_packets', 'rx_bytes', 'tx_bytes',
+             'storm_dropped_packets', 'storm_dropped_bytes', 'last_clear'),
+    'queue': ('enqueued', 'dequeued', 'dropped', 'current_depth',
+              'max_depth', 'last_clear'),
+    'routing': ('routed_packets', 'routed_bytes', 'routing_failures',
+                'arp_requests', 'arp_replies', 'last_clear'),
+    'int': ('switch_id', 'egress_port', 'packets', 'latency_total_ns',
+            'latency_max_ns', 'depth_total', 'depth_max'),
+}
+
+UINT64_MASK = (1 << 64) - 1
+
+
+def _varint(data: bytes, pos: int) -> Tuple[int, int]:
+    """Decode an LEB128 varint; returns the value and the next position"""
+    value = 0
+    shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7f) << shift
+        if byte < 0x80:
+            return value, pos
+        shift += 7
+
+
+def decode_datagram(data: bytes) -> Dict[str, Any]:
+    """
+    Decode one telemetry datagram
+
+    Args:
+        data: Datagram payload
+
+    Returns:
+        Dictionary with the header fields and a list of records, each a
+        (object type, index, {counter number: value}) tuple. Values are
+        absolute in keyframes and signed deltas otherwise.
+
+    Raises:
+        ValueError: If the datagram is not telemetry of a known version
+    """
+    if len(data) < HEADER.size:
+        raise ValueError("datagram shorter than the header")
+    magic, version, flags, _reserved, sequence, interval, time_ns = HEADER.unpack_from(data, 0)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a version 1 telemetry datagram")
+
+    keyframe = bool(flags & FLAG_KEYFRAME)
+    records = []
+    pos = HEADER.size
+    while pos < len(data):
+        obj = data[pos]
+        index, pos = _varint(data, pos + 1)
+        mask, pos = _varint(data, pos)
+        values = {}
+        bit = 0
+        while mask >> bit:
+            if mask & (1 << bit):
+                value, pos = _varint(data, pos)
+                if not keyframe:
+                    # Zigzag back to a signed delta
+                    value = (value >> 1) ^ -(value & 1)
+                values[bit] = value
+            bit += 1
+        records.append((obj, index, values))
+
+    return {
+        'sequence': sequence,
+        'interval': interval,
+        'time_ns': time_ns,
+        'keyframe': keyframe,
+        'end': bool(flags & FLAG_END),
+        'records': records,
+    }
+
+
+class TelemetryReceiver:
+    """Receives telemetry datagrams and maintains the counters they describe"""
+
+    def __init__(self, host: str = '0.0.0.0', port: int = 9400):
+        """
+        Bind the receiving socket
+
+        Args:
+            host: Address to listen on
+            port: UDP port the simulator pushes to
+        """
+        self._sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self._sock.bind((host, port))
+        self._counters: Dict[Tuple[str, int], List[int]] = {}
+        self._next_sequence: Optional[int] = None
+        self._keyframe_interval: Optional[int] = None
+        self.synchronized = False
+        self.lost_datagrams = 0
+        self.last_interval_time_ns = 0
+
+    def close(self):
+        """Close the socket"""
+        self._sock.close()
+
+    def receive(self, timeout: Optional[float] = None) -> bool:
+        """
+        Receive and apply one datagram
+
+        Args:
+            timeout: Seconds to wait, None to block
+
+        Returns:
+            bool: True if a datagram was applied, False on timeout
+        """
+        self._sock.settimeout(timeout)
+        try:
+            data = self._sock.recv(65535)
+        except socket.timeout:
+            return False
+
+        try:
+            message = decode_datagram(data)
+        except (ValueError, IndexError) as e:
+            logger.warning(f"Dropping malformed telemetry datagram: {e}")
+            return False
+
+        self.apply(message)
+        return True
+
+    def apply(self, message: Dict[str, Any]):
+        """
+        Apply a decoded datagram to the counters
+
+        Args:
+            message: Result of decode_datagram()
+        """
+        if self._next_sequence is not None and message['sequence'] != self._next_sequence:
+            gap = (message['sequence'] - self._next_sequence) & 0xffffffff
+            self.lost_datagrams += gap
+            # Deltas of the lost datagrams are gone until the next keyframe
+            self.synchronized = False
+            logger.warning(f"Lost {gap} telemetry datagrams, waiting for a keyframe")
+        self._next_sequence = (message['sequence'] + 1) & 0xffffffff
+
+        if message['keyframe']:
+            if self._keyframe_interval != message['interval']:
+                # Objects absent from a keyframe no longer exist
+                self._counters = {}
+                self._keyframe_interval = message['interval']
+            self.synchronized = True
+        elif not self.synchronized:
+            return
+
+        for obj, index, values in message['records']:
+            if obj >= len(OBJECT_TYPES):
+                continue
+            name = OBJECT_TYPES[obj]
+            counters = self._counters.setdefault((name, index), [0] * len(COUNTER_NAMES[name]))
+            for bit, value in values.items():
+                if bit >= len(counters):
+                    counters.extend([0] * (bit + 1 - len(counters)))
+                if message['keyframe']:
+                    counters[bit] = value
+                else:
+                    counters[bit] = (counters[bit] + value) & UINT64_MASK
+
+        if message['end']:
+            self.last_interval_time_ns = message['time_ns']
+
+    def get(self, obj: str, index: int = 0) -> Optional[Dict[str, int]]:
+        """
+        Get the current counters of an object
+
+        Args:
+            obj: 'port', 'vlan', 'queue', 'routing' or 'int'
+            index: Port, VLAN ID, port * queues + queue, INT hop slot, or 0 for routing
+
+        Returns:
+            Counters by name, or None if the object has not been reported
+        """
+        counters = self._counters.get((obj, index))
+        if counters is None:
+            return None
+        names = COUNTER_NAMES[obj]
+        return {names[i] if i < len(names) else f'counter_{i}': v for i, v in enumerate(counters)}
+
+    def objects(self, obj: str) -> List[int]:
+        """Indexes of the reported objects of a type"""
+        return sorted(index for name, index in self._counters if name == obj)
@@ -0,0 +1,20 @@
+/**
+ * @file bitmap.c
+ * @brief Out-of-line bitmap operations
+ */
+
+#include "../../include/common/bitmap.h"
+
+uint32_t bitmap_collect(const uint64_t *map, uint32_t words, uint16_t *list, uint32_t max) {
+    uint32_t count = 0;
+
+    for (uint32_t w = 0; w < words && count < max; w++) {
+        uint64_t bits = map[w];
+        while (bits && count < max) {
+            list[count++] = (uint16_t)(w * 64 + (uint32_t)__builtin_ctzll(bits));
+            bits &= bits - 1;
+        }
+    }
+
+    return count;
+}
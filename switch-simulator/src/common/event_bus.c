@@ -0,0 +1,573 @@
+/**
+ * @file event_bus.c
+ * @brief Internal publish/subscribe bus for control plane events
+ *
+ * The ring is the same bounded queue of many producers and one consumer
+ * as the event feed's: producers claim a position by CAS on the tail and
+ * publish the cell with its sequence number. The one consumer is the
+ * event loop, so the subscribers' queues are views of the batch it takes
+ * off the ring; a producer pays for one cell whatever the fan-out.
+ *
+ * Coalescing works on a batch from its newest event backwards: the first
+ * event met for an object is kept, older ones of the same object are
+ * folded into it and dropped. An STP role change keeps the role of the
+ * oldest event as its old value, and a route that was added and then
+ * changed in the same batch is still reported as added.
+ */
+
+#include "../../include/common/event_bus.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "../../include/common/config.h"
+#include "../../include/common/event_loop.h"
+#include "../../include/common/logging.h"
+
+#define EVENT_BUS_RING_MASK     ((uint64_t)CONFIG_EVENT_BUS_RING_SIZE - 1)
+#define EVENT_BUS_HASH_SIZE     (2 * CONFIG_EVENT_BUS_BATCH)
+#define EVENT_BUS_HASH_EMPTY    UINT16_MAX
+
+_Static_assert((CONFIG_EVENT_BUS_RING_SIZE & (CONFIG_EVENT_BUS_RING_SIZE - 1)) == 0,
+               "CONFIG_EVENT_BUS_RING_SIZE must be a power of two");
+_Static_assert((EVENT_BUS_HASH_SIZE & (EVENT_BUS_HASH_SIZE - 1)) == 0,
+               "CONFIG_EVENT_BUS_BATCH must be a power of two");
+_Static_assert(CONFIG_EVENT_BUS_BATCH < EVENT_BUS_HASH_EMPTY, "batch indexes must fit the hash");
+
+/**
+ * @brief Ring cell: position + 1 once written, position + ring size once read
+ */
+typedef struct {
+    uint64_t seq;
+    event_feed_event_t event;
+} event_bus_cell_t;
+
+/**
+ * @brief One subscription
+ */
+typedef struct {
+    const char *name;
+    uint32_t kinds;
+    uint32_t flags;
+    event_bus_handler_t handler;
+    void *user_data;
+    bool active;
+    event_bus_subscriber_stats_t stats;
+} event_bus_subscriber_t;
+
+/**
+ * @brief Bus state
+ */
+typedef struct {
+    pthread_mutex_t lock;                               /* Subscriptions; held while delivering */
+    bool initialized;
+    event_bus_cell_t *cells;                            /* Published before any kind is on */
+    int fd;
+    uint64_t tail __attribute__((aligned(64)));        /* Next position of producers */
+    bool signaled;                                      /* The eventfd has a pending write */
+    uint64_t published;
+    uint64_t dropped;
+    uint64_t head __attribute__((aligned(64)));        /* Next position of the event loop */
+    uint64_t batches;
+    uint32_t subscriber_count;
+    event_bus_subscriber_t subscribers[CONFIG_EVENT_BUS_MAX_SUBSCRIBERS];
+    event_feed_event_t batch[CONFIG_EVENT_BUS_BATCH];   /* Taken off the ring */
+    event_feed_event_t view[CONFIG_EVENT_BUS_BATCH];    /* What one subscriber gets */
+    uint16_t hash[EVENT_BUS_HASH_SIZE];
+} event_bus_t;
+
+uint32_t g_event_bus_kinds = 0;
+
+static event_bus_t g_event_bus = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .fd = -1,
+};
+
+/**
+ * @brief Recompute the kinds producers post for the bus
+ *
+ * Called with the subscription lock held.
+ */
+static void event_bus_update_kinds(void) {
+    uint32_t kinds = 0;
+
+    for (uint32_t i = 0; i < CONFIG_EVENT_BUS_MAX_SUBSCRIBERS; i++) {
+        if (g_event_bus.subscribers[i].active) {
+            kinds |= g_event_bus.subscribers[i].kinds;
+        }
+    }
+    __atomic_store_n(&g_event_bus_kinds, kinds, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Wake the event loop unless a wakeup is already pending
+ */
+static void event_bus_signal(void) {
+    if (!__atomic_exchange_n(&g_event_bus.signaled, true, __ATOMIC_SEQ_CST)) {
+        uint64_t one = 1;
+        if (write(g_event_bus.fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            LOG_WARNING(LOG_CATEGORY_SYSTEM, "Failed to signal the event bus: %s", strerror(errno));
+        }
+    }
+}
+
+void event_bus_publish(const event_feed_event_t *event) {
+    event_bus_cell_t *cells = __atomic_load_n(&g_event_bus.cells, __ATOMIC_ACQUIRE);
+    event_bus_cell_t *cell;
+    uint64_t pos;
+
+    if (!cells) {
+        return;
+    }
+
+    pos = __atomic_load_n(&g_event_bus.tail, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = &cells[pos & EVENT_BUS_RING_MASK];
+        int64_t diff = (int64_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&g_event_bus.tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* The event loop has not freed the cell from a lap ago */
+            __atomic_fetch_add(&g_event_bus.dropped, 1, __ATOMIC_RELAXED);
+            event_bus_signal();
+            return;
+        } else {
+            pos = __atomic_load_n(&g_event_bus.tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->event = *event;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&g_event_bus.published, 1, __ATOMIC_RELAXED);
+    event_bus_signal();
+}
+
+/**
+ * @brief Whether two events are about the same object
+ *
+ * MAC learn and age share the entry, route add, delete and change share
+ * the prefix.
+ */
+static bool event_bus_same_object(const event_feed_event_t *a, const event_feed_event_t *b) {
+    switch (a->kind) {
+    case EVENT_FEED_MAC_LEARN:
+    case EVENT_FEED_MAC_AGE:
+        return (b->kind == EVENT_FEED_MAC_LEARN || b->kind == EVENT_FEED_MAC_AGE) &&
+               a->vlan_id == b->vlan_id && memcmp(a->mac, b->mac, MAC_ADDR_LEN) == 0;
+    case EVENT_FEED_ROUTE_ADD:
+    case EVENT_FEED_ROUTE_DELETE:
+    case EVENT_FEED_ROUTE_CHANGE:
+        return (b->kind == EVENT_FEED_ROUTE_ADD || b->kind == EVENT_FEED_ROUTE_DELETE ||
+                b->kind == EVENT_FEED_ROUTE_CHANGE) &&
+               a->vlan_id == b->vlan_id && a->prefix_len == b->prefix_len &&
+               a->is_ipv6 == b->is_ipv6 && memcmp(a->addr, b->addr, sizeof(a->addr)) == 0;
+    default:
+        return a->kind == b->kind && a->port_id == b->port_id;
+    }
+}
+
+/**
+ * @brief Hash of the object an event is about, see event_bus_same_object()
+ */
+static uint32_t event_bus_object_hash(const event_feed_event_t *event) {
+    uint64_t h;
+
+    switch (event->kind) {
+    case EVENT_FEED_MAC_LEARN:
+    case EVENT_FEED_MAC_AGE:
+        h = 1;
+        for (uint32_t i = 0; i < MAC_ADDR_LEN; i++) {
+            h = (h << 8) | event->mac[i];
+        }
+        h ^= (uint64_t)event->vlan_id << 48;
+        break;
+    case EVENT_FEED_ROUTE_ADD:
+    case EVENT_FEED_ROUTE_DELETE:
+    case EVENT_FEED_ROUTE_CHANGE: {
+        uint64_t lo, hi;
+        memcpy(&lo, event->addr, sizeof(lo));
+        memcpy(&hi, event->addr + 8, sizeof(hi));
+        h = 2 ^ lo ^ (hi * 0x9E3779B97F4A7C15ULL) ^
+            ((uint64_t)event->vlan_id << 16) ^ ((uint64_t)event->prefix_len << 8) ^ event->is_ipv6;
+        break;
+    }
+    default:
+        h = ((uint64_t)event->kind << 32) | event->port_id;
+        break;
+    }
+    h *= 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(h >> 32);
+}
+
+/**
+ * @brief Fold an older event of the same object into the kept one
+ */
+static void event_bus_fold(event_feed_event_t *kept, const event_feed_event_t *older) {
+    if (kept->kind == EVENT_FEED_STP_ROLE) {
+        kept->old_value = older->old_value;
+    } else if (kept->kind == EVENT_FEED_ROUTE_CHANGE && older->kind == EVENT_FEED_ROUTE_ADD) {
+        kept->kind = EVENT_FEED_ROUTE_ADD;
+    }
+}
+
+/**
+ * @brief Build a subscriber's view of the batch
+ *
+ * @return Events in the view
+ */
+static uint32_t event_bus_build_view(const event_bus_subscriber_t *sub, uint32_t count,
+                                     uint64_t *coalesced) {
+    uint32_t n = 0;
+
+    if (!(sub->flags & EVENT_BUS_COALESCE)) {
+        for (uint32_t i = 0; i < count; i++) {
+            if ((sub->kinds >> g_event_bus.batch[i].kind) & 1) {
+                g_event_bus.view[n++] = g_event_bus.batch[i];
+            }
+        }
+        return n;
+    }
+
+    /* Newest first into the tail of the view, then slide it to the front */
+    memset(g_event_bus.hash, 0xff, sizeof(g_event_bus.hash));
+    uint32_t first = CONFIG_EVENT_BUS_BATCH;
+    for (uint32_t i = count; i-- > 0;) {
+        const event_feed_event_t *event = &g_event_bus.batch[i];
+        uint32_t slot;
+        bool folded = false;
+
+        if (!((sub->kinds >> event->kind) & 1)) {
+            continue;
+        }
+        for (slot = event_bus_object_hash(event) & (EVENT_BUS_HASH_SIZE - 1);
+             g_event_bus.hash[slot] != EVENT_BUS_HASH_EMPTY;
+             slot = (slot + 1) & (EVENT_BUS_HASH_SIZE - 1)) {
+            event_feed_event_t *kept = &g_event_bus.view[g_event_bus.hash[slot]];
+            if (event_bus_same_object(kept, event)) {
+                event_bus_fold(kept, event);
+                (*coalesced)++;
+                folded = true;
+                break;
+            }
+        }
+        if (!folded) {
+            g_event_bus.view[--first] = *event;
+            g_event_bus.hash[slot] = (uint16_t)first;
+        }
+    }
+
+    n = CONFIG_EVENT_BUS_BATCH - first;
+    if (first > 0) {
+        memmove(g_event_bus.view, &g_event_bus.view[first], n * sizeof(event_feed_event_t));
+    }
+    return n;
+}
+
+/**
+ * @brief Take up to a batch off the ring
+ */
+static uint32_t event_bus_take(event_bus_cell_t *cells) {
+    uint32_t taken = 0;
+
+    while (taken < CONFIG_EVENT_BUS_BATCH) {
+        uint64_t pos = g_event_bus.head;
+        event_bus_cell_t *cell = &cells[pos & EVENT_BUS_RING_MASK];
+
+        if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+            break;
+        }
+        g_event_bus.batch[taken++] = cell->event;
+        __atomic_store_n(&cell->seq, pos + CONFIG_EVENT_BUS_RING_SIZE, __ATOMIC_RELEASE);
+        g_event_bus.head = pos + 1;
+    }
+    return taken;
+}
+
+uint32_t event_bus_dispatch(void) {
+    event_bus_cell_t *cells = __atomic_load_n(&g_event_bus.cells, __ATOMIC_ACQUIRE);
+    uint64_t value;
+    uint32_t total = 0;
+    uint32_t taken;
+
+    if (!cells) {
+        return 0;
+    }
+
+    /* Clear before draining: an event the drain misses signals again */
+    if (read(g_event_bus.fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Failed to read the event bus eventfd: %s", strerror(errno));
+    }
+    __atomic_store_n(&g_event_bus.signaled, false, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock(&g_event_bus.lock);
+    do {
+        taken = event_bus_take(cells);
+        if (taken == 0) {
+            break;
+        }
+        g_event_bus.batches++;
+        total += taken;
+
+        for (uint32_t s = 0; s < CONFIG_EVENT_BUS_MAX_SUBSCRIBERS; s++) {
+            event_bus_subscriber_t *sub = &g_event_bus.subscribers[s];
+            uint32_t n;
+
+            if (!sub->active) {
+                continue;
+            }
+            n = event_bus_build_view(sub, taken, &sub->stats.coalesced);
+            if (n > 0) {
+                sub->handler(g_event_bus.view, n, sub->user_data);
+                sub->stats.delivered += n;
+                sub->stats.calls++;
+            }
+        }
+        /* A round takes at most one ring's worth, so producers cannot keep the loop here */
+    } while (taken == CONFIG_EVENT_BUS_BATCH && total < CONFIG_EVENT_BUS_RING_SIZE);
+    pthread_mutex_unlock(&g_event_bus.lock);
+
+    if (taken == CONFIG_EVENT_BUS_BATCH) {
+        /* Events may be left behind; come back on the next loop iteration */
+        event_bus_signal();
+    }
+    return total;
+}
+
+/**
+ * @brief Event loop callback of the ring's eventfd
+ */
+static void event_bus_fd_cb(int fd, uint32_t events, void *arg) {
+    (void)fd;
+    (void)events;
+    (void)arg;
+    (void)event_bus_dispatch();
+}
+
+/**
+ * @brief Create the ring and its eventfd
+ *
+ * Called with the subscription lock held. Producers may still be posting
+ * when the bus shuts down, so the ring lives until the process exits.
+ */
+static status_t event_bus_create(void) {
+    event_bus_cell_t *cells = calloc(CONFIG_EVENT_BUS_RING_SIZE, sizeof(event_bus_cell_t));
+
+    if (!cells) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to allocate the event bus ring");
+        return STATUS_NO_MEMORY;
+    }
+    for (uint64_t i = 0; i < CONFIG_EVENT_BUS_RING_SIZE; i++) {
+        cells[i].seq = i;
+    }
+
+    g_event_bus.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_event_bus.fd < 0) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to create the event bus eventfd: %s", strerror(errno));
+        free(cells);
+        return STATUS_NO_MEMORY;
+    }
+
+    __atomic_store_n(&g_event_bus.cells, cells, __ATOMIC_RELEASE);
+    return STATUS_SUCCESS;
+}
+
+status_t event_bus_init(void) {
+    status_t status = STATUS_SUCCESS;
+
+    pthread_mutex_lock(&g_event_bus.lock);
+    if (g_event_bus.initialized) {
+        pthread_mutex_unlock(&g_event_bus.lock);
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    if (!g_event_bus.cells) {
+        status = event_bus_create();
+    } else {
+        /* Posted after the last shutdown, when nobody was subscribed */
+        while (event_bus_take(g_event_bus.cells) > 0) {
+        }
+    }
+    if (status == STATUS_SUCCESS) {
+        status = event_loop_add_fd(g_event_bus.fd, EPOLLIN, event_bus_fd_cb, NULL);
+    }
+    if (status == STATUS_SUCCESS) {
+        g_event_bus.subscriber_count = 0;
+        memset(g_event_bus.subscribers, 0, sizeof(g_event_bus.subscribers));
+        g_event_bus.initialized = true;
+    }
+    pthread_mutex_unlock(&g_event_bus.lock);
+
+    if (status == STATUS_SUCCESS) {
+        LOG_INFO(LOG_CATEGORY_SYSTEM, "Event bus ready: %u events, batches of %u",
+                 CONFIG_EVENT_BUS_RING_SIZE, CONFIG_EVENT_BUS_BATCH);
+    }
+    return status;
+}
+
+status_t event_bus_shutdown(void) {
+    pthread_mutex_lock(&g_event_bus.lock);
+    if (!g_event_bus.initialized) {
+        pthread_mutex_unlock(&g_event_bus.lock);
+        return STATUS_NOT_INITIALIZED;
+    }
+    (void)event_loop_remove_fd(g_event_bus.fd);
+    pthread_mutex_unlock(&g_event_bus.lock);
+
+    (void)event_bus_dispatch();
+
+    pthread_mutex_lock(&g_event_bus.lock);
+    memset(g_event_bus.subscribers, 0, sizeof(g_event_bus.subscribers));
+    g_event_bus.subscriber_count = 0;
+    event_bus_update_kinds();
+    g_event_bus.initialized = false;
+    pthread_mutex_unlock(&g_event_bus.lock);
+
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Event bus stopped after %llu events",
+             (unsigned long long)__atomic_load_n(&g_event_bus.published, __ATOMIC_RELAXED));
+    return STATUS_SUCCESS;
+}
+
+status_t event_bus_subscribe(const char *name, uint32_t kinds, uint32_t flags,
+                             event_bus_handler_t handler, void *user_data, uint32_t *id) {
+    status_t status = STATUS_RESOURCE_EXHAUSTED;
+
+    if (!name || !handler || !id || kinds == 0 || (kinds & ~EVENT_FEED_ALL_KINDS) ||
+        (flags & ~EVENT_BUS_COALESCE)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_event_bus.lock);
+    if (!g_event_bus.initialized) {
+        pthread_mutex_unlock(&g_event_bus.lock);
+        return STATUS_NOT_INITIALIZED;
+    }
+    for (uint32_t i = 0; i < CONFIG_EVENT_BUS_MAX_SUBSCRIBERS; i++) {
+        event_bus_subscriber_t *sub = &g_event_bus.subscribers[i];
+
+        if (sub->active) {
+            continue;
+        }
+        memset(sub, 0, sizeof(*sub));
+        sub->name = name;
+        sub->kinds = kinds;
+        sub->flags = flags;
+        sub->handler = handler;
+        sub->user_data = user_data;
+        sub->active = true;
+        g_event_bus.subscriber_count++;
+        event_bus_update_kinds();
+        *id = i;
+        status = STATUS_SUCCESS;
+        break;
+    }
+    pthread_mutex_unlock(&g_event_bus.lock);
+
+    if (status == STATUS_SUCCESS) {
+        LOG_INFO(LOG_CATEGORY_SYSTEM, "Event bus: %s subscribed to 0x%x", name, kinds);
+    } else {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Event bus: no room to subscribe %s", name);
+    }
+    return status;
+}
+
+status_t event_bus_unsubscribe(uint32_t id) {
+    status_t status = STATUS_NOT_FOUND;
+
+    pthread_mutex_lock(&g_event_bus.lock);
+    if (!g_event_bus.initialized) {
+        status = STATUS_NOT_INITIALIZED;
+    } else if (id < CONFIG_EVENT_BUS_MAX_SUBSCRIBERS && g_event_bus.subscribers[id].active) {
+        g_event_bus.subscribers[id].active = false;
+        g_event_bus.subscriber_count--;
+        event_bus_update_kinds();
+        status = STATUS_SUCCESS;
+    }
+    pthread_mutex_unlock(&g_event_bus.lock);
+
+    return status;
+}
+
+status_t event_bus_get_stats(event_bus_stats_t *stats) {
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    stats->published = __atomic_load_n(&g_event_bus.published, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&g_event_bus.dropped, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&g_event_bus.lock);
+    stats->batches = g_event_bus.batches;
+    stats->subscribers = g_event_bus.subscriber_count;
+    pthread_mutex_unlock(&g_event_bus.lock);
+    return STATUS_SUCCESS;
+}
+
+status_t event_bus_get_subscriber_stats(uint32_t id, event_bus_subscriber_stats_t *stats) {
+    status_t status = STATUS_NOT_FOUND;
+
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_event_bus.lock);
+    if (id < CONFIG_EVENT_BUS_MAX_SUBSCRIBERS && g_event_bus.subscribers[id].active) {
+        *stats = g_event_bus.subscribers[id].stats;
+        status = STATUS_SUCCESS;
+    }
+    pthread_mutex_unlock(&g_event_bus.lock);
+    return status;
+}
+
+size_t event_bus_report(char *output, size_t output_len) {
+    event_bus_stats_t stats;
+    size_t used = 0;
+    int n;
+
+    if (!output || output_len == 0) {
+        return 0;
+    }
+    output[0] = '\0';
+
+#define EVENT_BUS_APPEND(...)                                                   \
+    do {                                                                        \
+        n = snprintf(output + (used < output_len ? used : output_len - 1),      \
+                     used < output_len ? output_len - used : 1, __VA_ARGS__);   \
+        if (n > 0) {                                                            \
+            used += (size_t)n;                                                  \
+        }                                                                       \
+    } while (0)
+
+    (void)event_bus_get_stats(&stats);
+    EVENT_BUS_APPEND("Event bus: %llu published, %llu dropped, %llu batches, %u subscribers\n",
+                     (unsigned long long)stats.published, (unsigned long long)stats.dropped,
+                     (unsigned long long)stats.batches, stats.subscribers);
+    EVENT_BUS_APPEND("%-3s %-16s %-10s %-8s %12s %12s %10s\n", "id", "subscriber", "kinds", "coalesce",
+                     "delivered", "coalesced", "calls");
+
+    pthread_mutex_lock(&g_event_bus.lock);
+    for (uint32_t i = 0; i < CONFIG_EVENT_BUS_MAX_SUBSCRIBERS; i++) {
+        const event_bus_subscriber_t *sub = &g_event_bus.subscribers[i];
+
+        if (!sub->active) {
+            continue;
+        }
+        EVENT_BUS_APPEND("%-3u %-16s 0x%-8x %-8s %12llu %12llu %10llu\n", i, sub->name, sub->kinds,
+                         (sub->flags & EVENT_BUS_COALESCE) ? "yes" : "no",
+                         (unsigned long long)sub->stats.delivered,
+                         (unsigned long long)sub->stats.coalesced,
+                         (unsigned long long)sub->stats.calls);
+    }
+    pthread_mutex_unlock(&g_event_bus.lock);
+
+#undef EVENT_BUS_APPEND
+    return used < output_len ? used : output_len - 1;
+}
@@ -0,0 +1,270 @@
+/**
+ * @file event_feed.c
+ * @brief Control plane event feed for external subscribers
+ *
+ * The ring is the bounded queue of many producers and one consumer used
+ * by the SAI notifications: every cell has a sequence number, producers
+ * claim a position by CAS on the tail. The eventfd is written only by the
+ * producer that finds the signaled flag clear, so a burst of events costs
+ * one write. The consumer clears the flag before draining, so an event
+ * posted behind the drain signals again.
+ */
+
+#include "../../include/common/event_feed.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "../../include/common/config.h"
+#include "../../include/common/event_bus.h"
+#include "../../include/common/logging.h"
+#include "../../include/common/sim_clock.h"
+
+#define EVENT_FEED_RING_MASK    ((uint64_t)CONFIG_EVENT_FEED_RING_SIZE - 1)
+
+_Static_assert((CONFIG_EVENT_FEED_RING_SIZE & (CONFIG_EVENT_FEED_RING_SIZE - 1)) == 0,
+               "CONFIG_EVENT_FEED_RING_SIZE must be a power of two");
+_Static_assert(sizeof(event_feed_event_t) == 40, "event_feed_event_t layout is shared with Python");
+_Static_assert(EVENT_FEED_KIND_COUNT <= 32, "kinds must fit the subscription mask");
+
+/**
+ * @brief Ring cell: position + 1 once written, position + ring size once read
+ */
+typedef struct {
+    uint64_t seq;
+    event_feed_event_t event;
+} event_feed_cell_t;
+
+/**
+ * @brief Event feed state
+ */
+typedef struct {
+    pthread_mutex_t lock;                               /* Serializes subscriptions */
+    event_feed_cell_t *cells;                           /* Published before any kind is on */
+    int fd;
+    uint64_t tail __attribute__((aligned(64)));        /* Next position of producers */
+    bool signaled;                                      /* The eventfd has a pending write */
+    uint64_t head __attribute__((aligned(64)));        /* Next position of the consumer */
+    event_feed_stats_t stats;
+} event_feed_t;
+
+uint32_t g_event_feed_kinds = 0;
+
+static event_feed_t g_event_feed = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .fd = -1,
+};
+
+/**
+ * @brief Create the ring and its eventfd
+ *
+ * Called with the subscription lock held.
+ */
+static status_t event_feed_create(void) {
+    event_feed_cell_t *cells = calloc(CONFIG_EVENT_FEED_RING_SIZE, sizeof(event_feed_cell_t));
+
+    if (!cells) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to allocate the event feed ring");
+        return STATUS_NO_MEMORY;
+    }
+    for (uint64_t i = 0; i < CONFIG_EVENT_FEED_RING_SIZE; i++) {
+        cells[i].seq = i;
+    }
+
+    g_event_feed.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_event_feed.fd < 0) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to create the event feed eventfd: %s", strerror(errno));
+        free(cells);
+        return STATUS_NO_MEMORY;
+    }
+
+    __atomic_store_n(&g_event_feed.cells, cells, __ATOMIC_RELEASE);
+    return STATUS_SUCCESS;
+}
+
+status_t event_feed_subscribe(uint32_t kinds, int *fd) {
+    status_t status = STATUS_SUCCESS;
+
+    if (kinds & ~EVENT_FEED_ALL_KINDS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_event_feed.lock);
+    if (!g_event_feed.cells) {
+        status = event_feed_create();
+    }
+    if (status == STATUS_SUCCESS) {
+        __atomic_store_n(&g_event_feed_kinds, kinds, __ATOMIC_RELEASE);
+        if (fd) {
+            *fd = g_event_feed.fd;
+        }
+        LOG_INFO(LOG_CATEGORY_SYSTEM, "Event feed subscription set to 0x%x", kinds);
+    }
+    pthread_mutex_unlock(&g_event_feed.lock);
+
+    return status;
+}
+
+/**
+ * @brief Wake the consumer unless a wakeup is already pending
+ */
+static void event_feed_signal(void) {
+    if (!__atomic_exchange_n(&g_event_feed.signaled, true, __ATOMIC_SEQ_CST)) {
+        uint64_t one = 1;
+        if (write(g_event_feed.fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            LOG_WARNING(LOG_CATEGORY_SYSTEM, "Failed to signal the event feed: %s", strerror(errno));
+        }
+    }
+}
+
+/**
+ * @brief Put an event on the feed ring
+ */
+static void event_feed_push(const event_feed_event_t *event) {
+    event_feed_cell_t *cells = __atomic_load_n(&g_event_feed.cells, __ATOMIC_ACQUIRE);
+    event_feed_cell_t *cell;
+    uint64_t pos;
+
+    if (!cells) {
+        return;
+    }
+
+    pos = __atomic_load_n(&g_event_feed.tail, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = &cells[pos & EVENT_FEED_RING_MASK];
+        int64_t diff = (int64_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&g_event_feed.tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* The consumer has not freed the cell from a lap ago */
+            __atomic_fetch_add(&g_event_feed.stats.dropped, 1, __ATOMIC_RELAXED);
+            event_feed_signal();
+            return;
+        } else {
+            pos = __atomic_load_n(&g_event_feed.tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->event = *event;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&g_event_feed.stats.posted, 1, __ATOMIC_RELAXED);
+    event_feed_signal();
+}
+
+void event_feed_post(event_feed_event_t *event) {
+    uint32_t bit = 1U << event->kind;
+
+    event->timestamp_us = sim_clock_now_us();
+    if (__atomic_load_n(&g_event_feed_kinds, __ATOMIC_RELAXED) & bit) {
+        event_feed_push(event);
+    }
+    if (__atomic_load_n(&g_event_bus_kinds, __ATOMIC_RELAXED) & bit) {
+        event_bus_publish(event);
+    }
+}
+
+status_t event_feed_read(event_feed_event_t *events, uint32_t max, uint32_t *count) {
+    event_feed_cell_t *cells = __atomic_load_n(&g_event_feed.cells, __ATOMIC_ACQUIRE);
+    uint64_t value;
+    uint32_t taken = 0;
+
+    if (!events || !count) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    *count = 0;
+    if (!cells) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    /* Clear before draining: an event the drain misses signals again */
+    if (read(g_event_feed.fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Failed to read the event feed eventfd: %s", strerror(errno));
+    }
+    __atomic_store_n(&g_event_feed.signaled, false, __ATOMIC_SEQ_CST);
+
+    while (taken < max) {
+        uint64_t pos = g_event_feed.head;
+        event_feed_cell_t *cell = &cells[pos & EVENT_FEED_RING_MASK];
+
+        if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+            break;
+        }
+        events[taken++] = cell->event;
+        __atomic_store_n(&cell->seq, pos + CONFIG_EVENT_FEED_RING_SIZE, __ATOMIC_RELEASE);
+        g_event_feed.head = pos + 1;
+    }
+
+    if (taken == max && max > 0) {
+        /* Events may be left behind; keep the descriptor readable */
+        event_feed_signal();
+    }
+
+    __atomic_fetch_add(&g_event_feed.stats.read, taken, __ATOMIC_RELAXED);
+    *count = taken;
+    return STATUS_SUCCESS;
+}
+
+status_t event_feed_get_stats(event_feed_stats_t *stats) {
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    stats->posted = __atomic_load_n(&g_event_feed.stats.posted, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&g_event_feed.stats.dropped, __ATOMIC_RELAXED);
+    stats->read = __atomic_load_n(&g_event_feed.stats.read, __ATOMIC_RELAXED);
+    return STATUS_SUCCESS;
+}
+
+void event_feed_post_mac(event_feed_kind_t kind, const mac_addr_t *mac, vlan_id_t vlan_id,
+                         port_id_t port_id) {
+    event_feed_event_t event = {
+        .kind = (uint16_t)kind,
+        .port_id = port_id,
+        .vlan_id = vlan_id,
+    };
+
+    memcpy(event.mac, mac->addr, MAC_ADDR_LEN);
+    event_feed_post(&event);
+}
+
+void event_feed_post_link(port_id_t port_id, uint8_t state) {
+    event_feed_event_t event = {
+        .kind = EVENT_FEED_LINK,
+        .port_id = port_id,
+        .new_value = state,
+    };
+
+    event_feed_post(&event);
+}
+
+void event_feed_post_route(event_feed_kind_t kind, uint16_t vrf_id, const uint8_t *prefix,
+                           uint8_t prefix_len, bool is_ipv6) {
+    event_feed_event_t event = {
+        .kind = (uint16_t)kind,
+        .vlan_id = vrf_id,
+        .prefix_len = prefix_len,
+        .is_ipv6 = is_ipv6,
+    };
+
+    memcpy(event.addr, prefix, is_ipv6 ? 16 : 4);
+    event_feed_post(&event);
+}
+
+void event_feed_post_stp_role(port_id_t port_id, uint8_t old_role, uint8_t new_role) {
+    event_feed_event_t event = {
+        .kind = EVENT_FEED_STP_ROLE,
+        .port_id = port_id,
+        .old_value = old_role,
+        .new_value = new_role,
+    };
+
+    event_feed_post(&event);
+}
@@ -0,0 +1,825 @@
+/**
+ * @file event_loop.c
+ * @brief Event loop and hierarchical timer wheel implementation
+ *
+ * The wheel has EVENT_WHEEL_LEVELS levels of EVENT_WHEEL_SLOTS slots.
+ * Level 0 holds timers due within the next 256 ticks, one slot per tick;
+ * a level k slot covers 256^k ticks. When level 0 wraps, the next level
+ * 1 slot is cascaded (its timers are re-inserted with their exact
+ * expiry), and so on upwards. A bitmap per level lets the loop find the
+ * earliest non-empty slot without walking the wheel, which is used both
+ * to skip empty ticks and to pick the next timerfd deadline.
+ *
+ * With the simulator clock in virtual mode the timerfd is never armed.
+ * The loop polls its descriptors without blocking while a timer is
+ * pending, and when nothing is ready it moves the clock straight to the
+ * next deadline and runs what is due.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "../../include/common/event_loop.h"
+#include "../../include/common/config.h"
+#include "../../include/common/logging.h"
+#include "../../include/common/sim_clock.h"
+
+#define EVENT_WHEEL_LEVELS      4
+#define EVENT_WHEEL_BITS        8
+#define EVENT_WHEEL_SLOTS       (1u << EVENT_WHEEL_BITS)
+#define EVENT_WHEEL_MASK        (EVENT_WHEEL_SLOTS - 1)
+#define EVENT_WHEEL_WORDS       (EVENT_WHEEL_SLOTS / 64)
+
+/**
+ * @brief Largest delay the wheel can represent, in ticks
+ */
+#define EVENT_WHEEL_MAX_DELAY   ((1ull << (EVENT_WHEEL_BITS * EVENT_WHEEL_LEVELS)) - 1)
+
+#define EVENT_LOOP_MAX_EVENTS   64
+#define EVENT_TICK_NONE         UINT64_MAX
+
+/**
+ * @brief event_timer_t.level of a timer taken off the wheel to be run
+ */
+#define EVENT_LEVEL_EXPIRED     0xFF
+
+/**
+ * @brief Watched file descriptor
+ */
+typedef struct event_fd_handler {
+    int fd;
+    event_fd_cb_t callback;
+    void *arg;
+    bool removed;
+    struct event_fd_handler *next;
+} event_fd_handler_t;
+
+/**
+ * @brief One wheel level
+ */
+typedef struct {
+    event_link_t slots[EVENT_WHEEL_SLOTS];
+    uint64_t occupied[EVENT_WHEEL_WORDS];
+} event_wheel_level_t;
+
+/**
+ * @brief Event loop state
+ */
+static struct {
+    bool initialized;
+    volatile bool running;
+    int epoll_fd;
+    int timer_fd;
+    int wake_fd;
+    uint64_t base_us;                       /**< Monotonic time of tick 0 */
+    uint64_t tick;                          /**< Next tick to process */
+    uint64_t armed_tick;                    /**< timerfd deadline, EVENT_TICK_NONE if disarmed */
+    pthread_mutex_t lock;                   /**< Protects the wheel */
+    event_wheel_level_t levels[EVENT_WHEEL_LEVELS];
+    event_fd_handler_t *handlers;           /**< Watched file descriptors */
+    event_loop_stats_t stats;
+} g_loop = { .epoll_fd = -1, .timer_fd = -1, .wake_fd = -1 };
+
+/* Markers for the internal descriptors in epoll_event.data.ptr */
+static char g_timer_marker;
+static char g_wake_marker;
+
+/*------------------------------------------------------------------------*/
+/* List and bitmap helpers                                                */
+/*------------------------------------------------------------------------*/
+
+static inline void event_list_init(event_link_t *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+static inline bool event_list_empty(const event_link_t *head) {
+    return head->next == head;
+}
+
+static inline void event_list_add_tail(event_link_t *head, event_link_t *link) {
+    link->prev = head->prev;
+    link->next = head;
+    head->prev->next = link;
+    head->prev = link;
+}
+
+static inline void event_list_del(event_link_t *link) {
+    link->prev->next = link->next;
+    link->next->prev = link->prev;
+    link->next = link;
+    link->prev = link;
+}
+
+/**
+ * @brief Move all entries of src to the tail of dst, leaving src empty
+ */
+static inline void event_list_splice_tail(event_link_t *dst, event_link_t *src) {
+    if (event_list_empty(src)) {
+        return;
+    }
+    src->next->prev = dst->prev;
+    dst->prev->next = src->next;
+    src->prev->next = dst;
+    dst->prev = src->prev;
+    event_list_init(src);
+}
+
+static inline void event_bit_set(uint64_t *bits, uint32_t i) {
+    bits[i >> 6] |= 1ull << (i & 63);
+}
+
+static inline void event_bit_clear(uint64_t *bits, uint32_t i) {
+    bits[i >> 6] &= ~(1ull << (i & 63));
+}
+
+/**
+ * @brief Find the first set bit at or after start, wrapping around
+ *
+ * @return Distance from start to the set bit, or EVENT_WHEEL_SLOTS if none
+ */
+static uint32_t event_bit_distance(const uint64_t *bits, uint32_t start) {
+    for (uint32_t n = 0; n <= EVENT_WHEEL_WORDS; n++) {
+        uint32_t word = ((start >> 6) + n) % EVENT_WHEEL_WORDS;
+        uint64_t v = bits[word];
+        if (n == 0) {
+            v &= ~0ull << (start & 63);
+        } else if (n == EVENT_WHEEL_WORDS) {
+            v &= (start & 63) ? ~(~0ull << (start & 63)) : 0;
+        }
+        if (v) {
+            uint32_t pos = (word << 6) + (uint32_t)__builtin_ctzll(v);
+            return (pos - start) & EVENT_WHEEL_MASK;
+        }
+    }
+    return EVENT_WHEEL_SLOTS;
+}
+
+/*------------------------------------------------------------------------*/
+/* Timer wheel (g_loop.lock held)                                         */
+/*------------------------------------------------------------------------*/
+
+static inline uint64_t event_us_to_ticks(uint64_t us) {
+    return (us + CONFIG_EVENT_LOOP_TICK_US - 1) / CONFIG_EVENT_LOOP_TICK_US;
+}
+
+static inline uint64_t event_current_tick(void) {
+    return (event_loop_now_us() - g_loop.base_us) / CONFIG_EVENT_LOOP_TICK_US;
+}
+
+/**
+ * @brief Put a timer into the slot matching its expiry
+ */
+static void wheel_insert(event_timer_t *timer) {
+    uint64_t expires = timer->expires;
+    uint32_t level = 0;
+
+    if (expires < g_loop.tick) {
+        // Already due: run on the next processed tick
+        expires = g_loop.tick;
+    }
+
+    uint64_t delta = expires - g_loop.tick;
+    while (level < EVENT_WHEEL_LEVELS - 1 &&
+           delta >= (1ull << (EVENT_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+
+    uint32_t slot = (uint32_t)(expires >> (EVENT_WHEEL_BITS * level)) & EVENT_WHEEL_MASK;
+    event_wheel_level_t *lv = &g_loop.levels[level];
+
+    timer->level = (uint8_t)level;
+    timer->slot = (uint8_t)slot;
+    event_list_add_tail(&lv->slots[slot], &timer->link);
+    event_bit_set(lv->occupied, slot);
+}
+
+/**
+ * @brief Remove a pending timer from its slot
+ */
+static void wheel_remove(event_timer_t *timer) {
+    event_list_del(&timer->link);
+
+    // Expired timers waiting to run are on a private list, not in a slot
+    if (timer->level < EVENT_WHEEL_LEVELS) {
+        event_wheel_level_t *lv = &g_loop.levels[timer->level];
+        if (event_list_empty(&lv->slots[timer->slot])) {
+            event_bit_clear(lv->occupied, timer->slot);
+        }
+    }
+}
+
+/**
+ * @brief Re-insert all timers of one slot of a higher level
+ *
+ * @return Slot index that was cascaded
+ */
+static uint32_t wheel_cascade(uint32_t level) {
+    event_wheel_level_t *lv = &g_loop.levels[level];
+    uint32_t slot = (uint32_t)(g_loop.tick >> (EVENT_WHEEL_BITS * level)) & EVENT_WHEEL_MASK;
+    event_link_t list;
+
+    event_list_init(&list);
+    event_list_splice_tail(&list, &lv->slots[slot]);
+    event_bit_clear(lv->occupied, slot);
+
+    while (!event_list_empty(&list)) {
+        event_timer_t *timer = (event_timer_t *)list.next;
+        event_list_del(&timer->link);
+        wheel_insert(timer);
+    }
+
+    return slot;
+}
+
+/**
+ * @brief Process ticks up to and including target
+ *
+ * Expired timers are moved to the expired list in expiry order.
+ */
+static void wheel_advance(uint64_t target, event_link_t *expired) {
+    event_wheel_level_t *l0 = &g_loop.levels[0];
+
+    while (g_loop.tick <= target) {
+        uint32_t idx = (uint32_t)g_loop.tick & EVENT_WHEEL_MASK;
+
+        if (idx == 0) {
+            for (uint32_t level = 1; level < EVENT_WHEEL_LEVELS; level++) {
+                if (wheel_cascade(level) != 0) {
+                    break;
+                }
+            }
+        }
+
+        if (!event_list_empty(&l0->slots[idx])) {
+            event_link_t *head = &l0->slots[idx];
+            for (event_link_t *l = head->next; l != head; l = l->next) {
+                ((event_timer_t *)l)->level = EVENT_LEVEL_EXPIRED;
+            }
+            event_list_splice_tail(expired, head);
+            event_bit_clear(l0->occupied, idx);
+        }
+
+        // Skip empty ticks up to the next occupied slot or the next wrap
+        uint32_t jump = EVENT_WHEEL_SLOTS - idx;
+        if (idx + 1 < EVENT_WHEEL_SLOTS) {
+            uint32_t dist = event_bit_distance(l0->occupied, idx + 1);
+            if (dist < EVENT_WHEEL_SLOTS && dist + 1 < jump) {
+                jump = dist + 1;
+            }
+        }
+        if (g_loop.tick + jump > target + 1) {
+            jump = (uint32_t)(target + 1 - g_loop.tick);
+        }
+        g_loop.tick += jump;
+    }
+}
+
+/**
+ * @brief Earliest tick at which something in the wheel may expire
+ *
+ * @return Lower bound tick, or EVENT_TICK_NONE if the wheel is empty
+ */
+static uint64_t wheel_next_tick(void) {
+    uint64_t best = EVENT_TICK_NONE;
+    uint64_t tick = g_loop.tick;
+
+    uint32_t dist = event_bit_distance(g_loop.levels[0].occupied, (uint32_t)tick & EVENT_WHEEL_MASK);
+    if (dist < EVENT_WHEEL_SLOTS) {
+        best = tick + dist;
+    }
+
+    for (uint32_t level = 1; level < EVENT_WHEEL_LEVELS; level++) {
+        uint32_t shift = EVENT_WHEEL_BITS * level;
+        uint64_t base = tick >> shift;
+        uint32_t cur = (uint32_t)base & EVENT_WHEEL_MASK;
+        const uint64_t *bits = g_loop.levels[level].occupied;
+
+        dist = event_bit_distance(bits, cur);
+        if (dist == EVENT_WHEEL_SLOTS) {
+            continue;
+        }
+
+        uint64_t when;
+        if (dist == 0 && (tick & ((1ull << shift) - 1)) == 0) {
+            // The current slot is cascaded when this tick is processed
+            when = tick;
+        } else {
+            if (dist == 0) {
+                dist = event_bit_distance(bits, (cur + 1) & EVENT_WHEEL_MASK) + 1;
+                if (dist > EVENT_WHEEL_SLOTS) {
+                    dist = EVENT_WHEEL_SLOTS;
+                }
+            }
+            when = (base + dist) << shift;
+        }
+
+        if (when < best) {
+            best = when;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * @brief Wake the loop out of epoll_wait()
+ */
+static void event_wake(void) {
+    uint64_t one = 1;
+
+    if (g_loop.wake_fd >= 0) {
+        ssize_t rc = write(g_loop.wake_fd, &one, sizeof(one));
+        (void)rc;
+    }
+}
+
+/**
+ * @brief Program the timerfd for a tick (EVENT_TICK_NONE disarms it)
+ */
+static void event_arm(uint64_t tick) {
+    struct itimerspec its;
+
+    if (sim_clock_is_virtual()) {
+        // No timerfd on a virtual clock. The loop polls while a timer is
+        // pending; only a loop blocked without one needs waking
+        if (tick != EVENT_TICK_NONE && g_loop.armed_tick == EVENT_TICK_NONE) {
+            event_wake();
+        }
+        g_loop.armed_tick = tick;
+        return;
+    }
+
+    memset(&its, 0, sizeof(its));
+    if (tick != EVENT_TICK_NONE) {
+        uint64_t us = g_loop.base_us + tick * CONFIG_EVENT_LOOP_TICK_US;
+        its.it_value.tv_sec = (time_t)(us / 1000000);
+        its.it_value.tv_nsec = (long)(us % 1000000) * 1000;
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+            its.it_value.tv_nsec = 1;
+        }
+    }
+
+    if (timerfd_settime(g_loop.timer_fd, TFD_TIMER_ABSTIME, &its, NULL) != 0) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to arm event loop timer: %s", strerror(errno));
+    }
+    g_loop.armed_tick = tick;
+}
+
+/**
+ * @brief Run expired timers, then re-arm the timerfd
+ */
+static void event_run_timers(void) {
+    event_link_t expired;
+
+    event_list_init(&expired);
+
+    pthread_mutex_lock(&g_loop.lock);
+    wheel_advance(event_current_tick(), &expired);
+
+    while (!event_list_empty(&expired)) {
+        event_timer_t *timer = (event_timer_t *)expired.next;
+        uint64_t now_us = event_loop_now_us();
+        uint64_t due_us = g_loop.base_us + timer->expires * CONFIG_EVENT_LOOP_TICK_US;
+
+        event_list_del(&timer->link);
+        if (timer->period) {
+            timer->expires += timer->period;
+            wheel_insert(timer);
+        } else {
+            timer->pending = false;
+            g_loop.stats.timers_pending--;
+        }
+
+        if (now_us > due_us && now_us - due_us > g_loop.stats.max_lateness_us) {
+            g_loop.stats.max_lateness_us = now_us - due_us;
+        }
+        g_loop.stats.timers_fired++;
+
+        event_timer_cb_t callback = timer->callback;
+        void *arg = timer->arg;
+
+        // Callbacks may start or stop timers, so run them unlocked
+        pthread_mutex_unlock(&g_loop.lock);
+        callback(timer, arg);
+        pthread_mutex_lock(&g_loop.lock);
+    }
+
+    event_arm(wheel_next_tick());
+    pthread_mutex_unlock(&g_loop.lock);
+}
+
+/*------------------------------------------------------------------------*/
+/* Public interface                                                       */
+/*------------------------------------------------------------------------*/
+
+/**
+ * @brief Current monotonic time in microseconds, from the simulator clock
+ *
+ * @return Monotonic time
+ */
+uint64_t event_loop_now_us(void) {
+    return sim_clock_now_us();
+}
+
+/**
+ * @brief Initialize the event loop
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t event_loop_init(void) {
+    struct epoll_event ev;
+
+    if (g_loop.initialized) {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Event loop already initialized");
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    g_loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    g_loop.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    g_loop.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_loop.epoll_fd < 0 || g_loop.timer_fd < 0 || g_loop.wake_fd < 0) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to create event loop descriptors: %s", strerror(errno));
+        goto fail;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = &g_timer_marker;
+    if (epoll_ctl(g_loop.epoll_fd, EPOLL_CTL_ADD, g_loop.timer_fd, &ev) != 0) {
+        goto fail;
+    }
+    ev.data.ptr = &g_wake_marker;
+    if (epoll_ctl(g_loop.epoll_fd, EPOLL_CTL_ADD, g_loop.wake_fd, &ev) != 0) {
+        goto fail;
+    }
+
+    for (uint32_t level = 0; level < EVENT_WHEEL_LEVELS; level++) {
+        for (uint32_t slot = 0; slot < EVENT_WHEEL_SLOTS; slot++) {
+            event_list_init(&g_loop.levels[level].slots[slot]);
+        }
+        memset(g_loop.levels[level].occupied, 0, sizeof(g_loop.levels[level].occupied));
+    }
+
+    pthread_mutex_init(&g_loop.lock, NULL);
+    memset(&g_loop.stats, 0, sizeof(g_loop.stats));
+    g_loop.base_us = event_loop_now_us();
+    g_loop.tick = 0;
+    g_loop.armed_tick = EVENT_TICK_NONE;
+    g_loop.handlers = NULL;
+    g_loop.running = false;
+    g_loop.initialized = true;
+
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Event loop initialized (tick %u us)", CONFIG_EVENT_LOOP_TICK_US);
+    return STATUS_SUCCESS;
+
+fail:
+    if (g_loop.epoll_fd >= 0) close(g_loop.epoll_fd);
+    if (g_loop.timer_fd >= 0) close(g_loop.timer_fd);
+    if (g_loop.wake_fd >= 0) close(g_loop.wake_fd);
+    g_loop.epoll_fd = g_loop.timer_fd = g_loop.wake_fd = -1;
+    return STATUS_FAILURE;
+}
+
+/**
+ * @brief Release the event loop
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t event_loop_shutdown(void) {
+    if (!g_loop.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    pthread_mutex_lock(&g_loop.lock);
+    for (uint32_t level = 0; level < EVENT_WHEEL_LEVELS; level++) {
+        for (uint32_t slot = 0; slot < EVENT_WHEEL_SLOTS; slot++) {
+            event_link_t *head = &g_loop.levels[level].slots[slot];
+            while (!event_list_empty(head)) {
+                event_timer_t *timer = (event_timer_t *)head->next;
+                event_list_del(&timer->link);
+                timer->pending = false;
+            }
+        }
+        memset(g_loop.levels[level].occupied, 0, sizeof(g_loop.levels[level].occupied));
+    }
+    g_loop.stats.timers_pending = 0;
+    pthread_mutex_unlock(&g_loop.lock);
+
+    while (g_loop.handlers) {
+        event_fd_handler_t *handler = g_loop.handlers;
+        g_loop.handlers = handler->next;
+        free(handler);
+    }
+
+    close(g_loop.epoll_fd);
+    close(g_loop.timer_fd);
+    close(g_loop.wake_fd);
+    g_loop.epoll_fd = g_loop.timer_fd = g_loop.wake_fd = -1;
+    pthread_mutex_destroy(&g_loop.lock);
+    g_loop.initialized = false;
+
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Event loop shut down");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Free fd handlers removed during the last dispatch round
+ */
+static void event_reap_handlers(void) {
+    event_fd_handler_t **link = &g_loop.handlers;
+
+    while (*link) {
+        event_fd_handler_t *handler = *link;
+        if (handler->removed) {
+            *link = handler->next;
+            free(handler);
+        } else {
+            link = &handler->next;
+        }
+    }
+}
+
+/**
+ * @brief Dispatch events and timers until event_loop_stop() is called
+ *
+ * @return STATUS_SUCCESS when stopped, appropriate error code otherwise
+ */
+status_t event_loop_run(void) {
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+
+    if (!g_loop.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    __atomic_store_n(&g_loop.running, true, __ATOMIC_RELEASE);
+
+    // Timers started before run() may already be due
+    event_run_timers();
+
+    while (__atomic_load_n(&g_loop.running, __ATOMIC_ACQUIRE)) {
+        bool virtual_clock = sim_clock_is_virtual();
+        uint64_t next = EVENT_TICK_NONE;
+
+        if (virtual_clock) {
+            pthread_mutex_lock(&g_loop.lock);
+            next = g_loop.armed_tick;
+            pthread_mutex_unlock(&g_loop.lock);
+        }
+
+        int n = epoll_wait(g_loop.epoll_fd, events, EVENT_LOOP_MAX_EVENTS,
+                           next != EVENT_TICK_NONE ? 0 : -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "epoll_wait failed: %s", strerror(errno));
+            return STATUS_FAILURE;
+        }
+
+        if (n == 0 && next != EVENT_TICK_NONE) {
+            // Idle on a virtual clock: skip the time until the next deadline
+            sim_clock_advance_to_us(g_loop.base_us + next * CONFIG_EVENT_LOOP_TICK_US);
+            g_loop.stats.clock_jumps++;
+            event_run_timers();
+            continue;
+        }
+
+        g_loop.stats.wakeups++;
+
+        for (int i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+            uint64_t value;
+
+            if (ptr == &g_timer_marker) {
+                while (read(g_loop.timer_fd, &value, sizeof(value)) > 0) {
+                }
+                event_run_timers();
+            } else if (ptr == &g_wake_marker) {
+                while (read(g_loop.wake_fd, &value, sizeof(value)) > 0) {
+                }
+            } else {
+                event_fd_handler_t *handler = (event_fd_handler_t *)ptr;
+                if (!handler->removed) {
+                    g_loop.stats.fd_events++;
+                    handler->callback(handler->fd, events[i].events, handler->arg);
+                }
+            }
+        }
+
+        event_reap_handlers();
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Make event_loop_run() return
+ */
+void event_loop_stop(void) {
+    __atomic_store_n(&g_loop.running, false, __ATOMIC_RELEASE);
+    event_wake();
+}
+
+/**
+ * @brief Prepare a timer for use
+ *
+ * @param timer Timer to initialize
+ * @param callback Expiry callback
+ * @param arg Callback argument
+ */
+void event_timer_init(event_timer_t *timer, event_timer_cb_t callback, void *arg) {
+    if (!timer) {
+        return;
+    }
+
+    memset(timer, 0, sizeof(*timer));
+    timer->link.next = &timer->link;
+    timer->link.prev = &timer->link;
+    timer->callback = callback;
+    timer->arg = arg;
+}
+
+/**
+ * @brief Arm a timer, re-arming it if it is already pending
+ *
+ * Deadlines further away than the wheel range (2^32 ticks) are capped.
+ *
+ * @param timer Initialized timer
+ * @param delay_us Time until the first expiry
+ * @param period_us Interval between later expiries, 0 for a one-shot timer
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t event_timer_start(event_timer_t *timer, uint64_t delay_us, uint64_t period_us) {
+    if (!g_loop.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (!timer || !timer->callback) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    uint64_t delay = event_us_to_ticks(delay_us);
+    if (delay > EVENT_WHEEL_MAX_DELAY) {
+        delay = EVENT_WHEEL_MAX_DELAY;
+    }
+
+    pthread_mutex_lock(&g_loop.lock);
+
+    if (timer->pending) {
+        wheel_remove(timer);
+    } else {
+        timer->pending = true;
+        g_loop.stats.timers_pending++;
+    }
+
+    // Deadlines are relative to now, not to the last processed tick
+    uint64_t now = event_current_tick();
+    timer->expires = (now > g_loop.tick ? now : g_loop.tick) + delay;
+    timer->period = period_us ? event_us_to_ticks(period_us) : 0;
+    if (period_us && timer->period == 0) {
+        timer->period = 1;
+    }
+    wheel_insert(timer);
+
+    if (timer->expires < g_loop.armed_tick) {
+        event_arm(timer->expires);
+    }
+
+    pthread_mutex_unlock(&g_loop.lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Disarm a timer
+ *
+ * @param timer Timer to stop
+ * @return true if the timer was pending
+ */
+bool event_timer_stop(event_timer_t *timer) {
+    bool was_pending = false;
+
+    if (!timer || !g_loop.initialized) {
+        return false;
+    }
+
+    pthread_mutex_lock(&g_loop.lock);
+    if (timer->pending) {
+        wheel_remove(timer);
+        timer->pending = false;
+        g_loop.stats.timers_pending--;
+        was_pending = true;
+    }
+    pthread_mutex_unlock(&g_loop.lock);
+
+    // The timerfd stays armed; an early wakeup just finds nothing to do
+    return was_pending;
+}
+
+/**
+ * @brief Check if a timer is armed
+ *
+ * @param timer Timer
+ * @return true if pending
+ */
+bool event_timer_pending(const event_timer_t *timer) {
+    return timer && __atomic_load_n(&timer->pending, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Watch a file descriptor
+ *
+ * @param fd File descriptor
+ * @param events epoll event mask
+ * @param callback Event callback
+ * @param arg Callback argument
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t event_loop_add_fd(int fd, uint32_t events, event_fd_cb_t callback, void *arg) {
+    struct epoll_event ev;
+
+    if (!g_loop.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (fd < 0 || !callback) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    event_fd_handler_t *handler = (event_fd_handler_t *)calloc(1, sizeof(event_fd_handler_t));
+    if (!handler) {
+        return STATUS_NO_MEMORY;
+    }
+    handler->fd = fd;
+    handler->callback = callback;
+    handler->arg = arg;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = handler;
+    if (epoll_ctl(g_loop.epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to watch fd %d: %s", fd, strerror(errno));
+        free(handler);
+        return STATUS_FAILURE;
+    }
+
+    handler->next = g_loop.handlers;
+    g_loop.handlers = handler;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Stop watching a file descriptor
+ *
+ * The handler is freed after the current dispatch round, so pending
+ * events for it in the same round are ignored safely.
+ *
+ * @param fd File descriptor
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if fd is not watched
+ */
+status_t event_loop_remove_fd(int fd) {
+    if (!g_loop.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    for (event_fd_handler_t *handler = g_loop.handlers; handler; handler = handler->next) {
+        if (handler->fd == fd && !handler->removed) {
+            epoll_ctl(g_loop.epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            handler->removed = true;
+            if (!__atomic_load_n(&g_loop.running, __ATOMIC_ACQUIRE)) {
+                event_reap_handlers();
+            }
+            return STATUS_SUCCESS;
+        }
+    }
+
+    return STATUS_NOT_FOUND;
+}
+
+/**
+ * @brief Get event loop counters
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t event_loop_get_stats(event_loop_stats_t *stats) {
+    if (!g_loop.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_loop.lock);
+    *stats = g_loop.stats;
+    pthread_mutex_unlock(&g_loop.lock);
+    return STATUS_SUCCESS;
+}
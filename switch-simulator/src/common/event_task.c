@@ -0,0 +1,460 @@
+/**
+ * @file event_task.c
+ * @brief Stackless cooperative tasks on the event loop
+ *
+ * The run queue is a ring of task pointers with many producers and the
+ * loop as its one consumer. A task is on it at most once: the queued flag
+ * is taken by whoever enqueues it and dropped by the loop just before the
+ * task runs, so a wakeup that arrives while the task runs puts it back
+ * for the next pass. The ring is sized for CONFIG_EVENT_TASK_MAX tasks
+ * and can therefore never be full.
+ *
+ * A pass runs the tasks that were queued when it started; a task that
+ * yields or is woken during the pass runs in the next one, after the
+ * loop has looked at its descriptors and timers again.
+ */
+
+#define _GNU_SOURCE
+#include "../../include/common/event_task.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../include/common/config.h"
+#include "../../include/common/logging.h"
+
+/**
+ * @brief Runtime state
+ */
+typedef struct {
+    pthread_mutex_t lock;           /* Task list */
+    bool initialized;
+    int fd;
+    int cpu;
+    bool signaled;                  /* The eventfd has a pending write */
+    ring_t *run_queue;
+    event_task_t *tasks;
+    uint32_t task_count;
+    uint64_t passes;
+    uint64_t runs;
+} event_task_runtime_t;
+
+static event_task_runtime_t g_tasks = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .fd = -1,
+    .cpu = -1,
+};
+
+static uint64_t event_task_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Wake the loop unless a wakeup is already pending
+ */
+static void event_task_signal(void) {
+    if (!__atomic_exchange_n(&g_tasks.signaled, true, __ATOMIC_SEQ_CST)) {
+        uint64_t one = 1;
+        if (write(g_tasks.fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            LOG_WARNING(LOG_CATEGORY_SYSTEM, "Failed to signal the task runtime: %s", strerror(errno));
+        }
+    }
+}
+
+/**
+ * @brief Take a task off the task list and out of its waits
+ *
+ * Called on the loop thread.
+ */
+static void event_task_release(event_task_t *task) {
+    (void)event_timer_stop(&task->timer);
+    if (task->wait_queue) {
+        event_task_queue_release(task->wait_queue, task);
+    }
+    __atomic_store_n(&task->state, EVENT_TASK_IDLE, __ATOMIC_RELAXED);
+    task->resume = 0;
+
+    pthread_mutex_lock(&g_tasks.lock);
+    for (event_task_t **link = &g_tasks.tasks; *link; link = &(*link)->next) {
+        if (*link == task) {
+            *link = task->next;
+            g_tasks.task_count--;
+            break;
+        }
+    }
+    task->next = NULL;
+    pthread_mutex_unlock(&g_tasks.lock);
+}
+
+/**
+ * @brief Run one task until it suspends
+ */
+static void event_task_run(event_task_t *task) {
+    uint64_t start, elapsed;
+    int result;
+
+    __atomic_store_n(&task->queued, false, __ATOMIC_SEQ_CST);
+    if (task->state == EVENT_TASK_IDLE) {
+        /* Cancelled while it was queued */
+        return;
+    }
+
+    __atomic_store_n(&task->state, EVENT_TASK_RUNNING, __ATOMIC_RELAXED);
+    start = event_task_now_ns();
+    result = task->fn(task);
+    elapsed = event_task_now_ns() - start;
+
+    task->stats.runs++;
+    task->stats.run_ns += elapsed;
+    if (elapsed > task->stats.max_run_ns) {
+        task->stats.max_run_ns = elapsed;
+    }
+    g_tasks.runs++;
+
+    switch (result) {
+    case EVENT_TASK_YIELDED:
+        __atomic_store_n(&task->state, EVENT_TASK_SLEEPING, __ATOMIC_RELAXED);
+        event_task_wake(task);
+        break;
+    case EVENT_TASK_WAITING:
+        __atomic_store_n(&task->state, EVENT_TASK_SLEEPING, __ATOMIC_RELAXED);
+        break;
+    default:
+        event_task_release(task);
+        break;
+    }
+}
+
+/**
+ * @brief Event loop callback of the run queue's eventfd: one pass
+ */
+static void event_task_fd_cb(int fd, uint32_t events, void *arg) {
+    uint64_t value;
+    uint32_t count;
+
+    (void)events;
+    (void)arg;
+
+    /* Clear before draining: a task queued behind the drain signals again */
+    if (read(fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Failed to read the task runtime eventfd: %s", strerror(errno));
+    }
+    __atomic_store_n(&g_tasks.signaled, false, __ATOMIC_SEQ_CST);
+
+    g_tasks.passes++;
+    count = ring_count(g_tasks.run_queue);
+    while (count-- > 0) {
+        void *task;
+
+        if (!ring_dequeue(g_tasks.run_queue, &task)) {
+            break;
+        }
+        event_task_run((event_task_t *)task);
+    }
+
+    if (ring_count(g_tasks.run_queue) > 0) {
+        event_task_signal();
+    }
+}
+
+/**
+ * @brief Timer of a sleeping task expired
+ */
+static void event_task_timer_cb(event_timer_t *timer, void *arg) {
+    event_task_t *task = (event_task_t *)arg;
+
+    (void)timer;
+    task->timed_out = true;
+    task->stats.timeouts++;
+    event_task_wake(task);
+}
+
+status_t event_task_init(int cpu) {
+    status_t status;
+
+    pthread_mutex_lock(&g_tasks.lock);
+    if (g_tasks.initialized) {
+        pthread_mutex_unlock(&g_tasks.lock);
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    g_tasks.run_queue = ring_create(CONFIG_EVENT_TASK_MAX, RING_F_SC_DEQ);
+    if (!g_tasks.run_queue) {
+        pthread_mutex_unlock(&g_tasks.lock);
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to allocate the task run queue");
+        return STATUS_NO_MEMORY;
+    }
+    g_tasks.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_tasks.fd < 0) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to create the task runtime eventfd: %s", strerror(errno));
+        ring_destroy(g_tasks.run_queue);
+        g_tasks.run_queue = NULL;
+        pthread_mutex_unlock(&g_tasks.lock);
+        return STATUS_NO_MEMORY;
+    }
+    status = event_loop_add_fd(g_tasks.fd, EPOLLIN, event_task_fd_cb, NULL);
+    if (status != STATUS_SUCCESS) {
+        close(g_tasks.fd);
+        g_tasks.fd = -1;
+        ring_destroy(g_tasks.run_queue);
+        g_tasks.run_queue = NULL;
+        pthread_mutex_unlock(&g_tasks.lock);
+        return status;
+    }
+
+    g_tasks.cpu = -1;
+    if (cpu >= 0) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+            g_tasks.cpu = cpu;
+        } else {
+            LOG_WARNING(LOG_CATEGORY_SYSTEM, "Task runtime: cannot pin the control plane to CPU %d", cpu);
+        }
+    }
+
+    g_tasks.signaled = false;
+    g_tasks.tasks = NULL;
+    g_tasks.task_count = 0;
+    g_tasks.passes = 0;
+    g_tasks.runs = 0;
+    g_tasks.initialized = true;
+    pthread_mutex_unlock(&g_tasks.lock);
+
+    if (g_tasks.cpu >= 0) {
+        LOG_INFO(LOG_CATEGORY_SYSTEM, "Task runtime ready on CPU %d", g_tasks.cpu);
+    } else {
+        LOG_INFO(LOG_CATEGORY_SYSTEM, "Task runtime ready");
+    }
+    return STATUS_SUCCESS;
+}
+
+status_t event_task_shutdown(void) {
+    if (!g_tasks.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    (void)event_loop_remove_fd(g_tasks.fd);
+    while (g_tasks.tasks) {
+        event_task_release(g_tasks.tasks);
+    }
+
+    pthread_mutex_lock(&g_tasks.lock);
+    g_tasks.initialized = false;
+    close(g_tasks.fd);
+    g_tasks.fd = -1;
+    ring_destroy(g_tasks.run_queue);
+    g_tasks.run_queue = NULL;
+    pthread_mutex_unlock(&g_tasks.lock);
+
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Task runtime stopped after %llu runs", (unsigned long long)g_tasks.runs);
+    return STATUS_SUCCESS;
+}
+
+status_t event_task_spawn(event_task_t *task, const char *name, event_task_fn_t fn, void *arg) {
+    if (!task || !name || !fn) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_tasks.lock);
+    if (!g_tasks.initialized) {
+        pthread_mutex_unlock(&g_tasks.lock);
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (task->state != EVENT_TASK_IDLE && task->fn != NULL) {
+        pthread_mutex_unlock(&g_tasks.lock);
+        return STATUS_ALREADY_EXISTS;
+    }
+    if (g_tasks.task_count >= CONFIG_EVENT_TASK_MAX) {
+        pthread_mutex_unlock(&g_tasks.lock);
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Task runtime: no room for task %s", name);
+        return STATUS_RESOURCE_EXHAUSTED;
+    }
+
+    /* A cancelled task may still sit on the run queue; keep its flag */
+    bool queued = __atomic_load_n(&task->queued, __ATOMIC_SEQ_CST);
+    memset(task, 0, sizeof(*task));
+    __atomic_store_n(&task->queued, queued, __ATOMIC_SEQ_CST);
+    task->fn = fn;
+    task->arg = arg;
+    task->name = name;
+    __atomic_store_n(&task->state, EVENT_TASK_SLEEPING, __ATOMIC_RELAXED);
+    event_timer_init(&task->timer, event_task_timer_cb, task);
+    task->next = g_tasks.tasks;
+    g_tasks.tasks = task;
+    g_tasks.task_count++;
+    pthread_mutex_unlock(&g_tasks.lock);
+
+    event_task_wake(task);
+    return STATUS_SUCCESS;
+}
+
+void event_task_cancel(event_task_t *task) {
+    if (!task || task->state == EVENT_TASK_IDLE || !g_tasks.initialized) {
+        return;
+    }
+
+    event_task_release(task);
+}
+
+void event_task_wake(event_task_t *task) {
+    if (__atomic_load_n(&task->state, __ATOMIC_RELAXED) == EVENT_TASK_IDLE) {
+        return;
+    }
+    if (__atomic_exchange_n(&task->queued, true, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+
+    __atomic_fetch_add(&task->stats.wakeups, 1, __ATOMIC_RELAXED);
+    /* Never full: a task is queued at most once and there are at most as many */
+    (void)ring_enqueue(g_tasks.run_queue, task);
+    event_task_signal();
+}
+
+void event_task_arm(event_task_t *task, uint64_t delay_us) {
+    task->timed_out = false;
+    if (event_timer_start(&task->timer, delay_us, 0) != STATUS_SUCCESS) {
+        /* No loop to wait on: the wait ends at once */
+        task->timed_out = true;
+        event_task_wake(task);
+    }
+}
+
+void event_task_disarm(event_task_t *task) {
+    (void)event_timer_stop(&task->timer);
+}
+
+status_t event_task_queue_init(event_task_queue_t *queue, uint32_t size) {
+    if (!queue) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(queue, 0, sizeof(*queue));
+    if (size == 0 || (size & (size - 1)) != 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    queue->ring = ring_create(size, RING_F_SC_DEQ);
+    return queue->ring ? STATUS_SUCCESS : STATUS_NO_MEMORY;
+}
+
+void event_task_queue_destroy(event_task_queue_t *queue) {
+    if (!queue) {
+        return;
+    }
+
+    ring_destroy(queue->ring);
+    queue->ring = NULL;
+    queue->waiter = NULL;
+}
+
+bool event_task_queue_push(event_task_queue_t *queue, void *item) {
+    event_task_t *waiter;
+
+    if (!ring_enqueue(queue->ring, item)) {
+        __atomic_fetch_add(&queue->dropped, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    /* Pairs with the waiter store in event_task_queue_take() */
+    waiter = __atomic_load_n(&queue->waiter, __ATOMIC_SEQ_CST);
+    if (waiter) {
+        event_task_wake(waiter);
+    }
+    return true;
+}
+
+void *event_task_queue_take(event_task_queue_t *queue, event_task_t *task) {
+    void *item = event_task_queue_pop(queue);
+
+    if (!item) {
+        __atomic_store_n(&queue->waiter, task, __ATOMIC_SEQ_CST);
+        task->wait_queue = queue;
+        item = event_task_queue_pop(queue);
+        if (!item) {
+            return NULL;
+        }
+    }
+    event_task_queue_release(queue, task);
+    return item;
+}
+
+void event_task_queue_release(event_task_queue_t *queue, event_task_t *task) {
+    if (__atomic_load_n(&queue->waiter, __ATOMIC_RELAXED) == task) {
+        __atomic_store_n(&queue->waiter, NULL, __ATOMIC_RELEASE);
+    }
+    task->wait_queue = NULL;
+}
+
+status_t event_task_get_runtime_stats(event_task_runtime_stats_t *stats) {
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_tasks.lock);
+    stats->tasks = g_tasks.task_count;
+    stats->passes = g_tasks.passes;
+    stats->runs = g_tasks.runs;
+    stats->cpu = g_tasks.cpu;
+    pthread_mutex_unlock(&g_tasks.lock);
+    return STATUS_SUCCESS;
+}
+
+size_t event_task_report(char *output, size_t output_len) {
+    static const char *const state_names[] = { "idle", "ready", "sleeping", "running" };
+    event_task_runtime_stats_t stats;
+    size_t used = 0;
+    int n;
+
+    if (!output || output_len == 0) {
+        return 0;
+    }
+    output[0] = '\0';
+
+#define EVENT_TASK_APPEND(...)                                                  \
+    do {                                                                        \
+        n = snprintf(output + (used < output_len ? used : output_len - 1),      \
+                     used < output_len ? output_len - used : 1, __VA_ARGS__);   \
+        if (n > 0) {                                                            \
+            used += (size_t)n;                                                  \
+        }                                                                       \
+    } while (0)
+
+    (void)event_task_get_runtime_stats(&stats);
+    EVENT_TASK_APPEND("Control tasks: %u, %llu passes, %llu runs, CPU %d\n", stats.tasks,
+                      (unsigned long long)stats.passes, (unsigned long long)stats.runs, stats.cpu);
+    EVENT_TASK_APPEND("%-20s %-9s %12s %12s %10s %12s %12s\n", "task", "state", "runs", "wakeups",
+                      "timeouts", "run-us", "max-run-us");
+
+    pthread_mutex_lock(&g_tasks.lock);
+    for (const event_task_t *task = g_tasks.tasks; task; task = task->next) {
+        bool queued = __atomic_load_n(&task->queued, __ATOMIC_RELAXED);
+        uint8_t state = __atomic_load_n(&task->state, __ATOMIC_RELAXED);
+
+        if (queued && state == EVENT_TASK_SLEEPING) {
+            state = EVENT_TASK_READY;
+        }
+
+        EVENT_TASK_APPEND("%-20s %-9s %12llu %12llu %10llu %12llu %12llu\n", task->name,
+                          state_names[state], (unsigned long long)task->stats.runs,
+                          (unsigned long long)task->stats.wakeups,
+                          (unsigned long long)task->stats.timeouts,
+                          (unsigned long long)(task->stats.run_ns / 1000),
+                          (unsigned long long)(task->stats.max_run_ns / 1000));
+    }
+    pthread_mutex_unlock(&g_tasks.lock);
+
+#undef EVENT_TASK_APPEND
+    return used < output_len ? used : output_len - 1;
+}
@@ -0,0 +1,188 @@
+/**
+ * @file init_graph.c
+ * @brief Startup dependency graph implementation
+ *
+ * One mutex and condition variable guard the whole run; steps are few and
+ * long, so there is nothing to gain from anything finer.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../../include/common/init_graph.h"
+#include "../../include/common/logging.h"
+
+/**
+ * @brief State shared by the threads of one run
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;         /**< A step finished */
+    const init_step_t *steps;
+    uint32_t count;
+    uint64_t started;               /**< Bit per step taken by a thread */
+    uint64_t done;                  /**< Bit per step that succeeded */
+    uint32_t running;               /**< Steps being run */
+    status_t status;                /**< First failure, STATUS_SUCCESS if none */
+    init_step_result_t *results;    /**< Outcome of every step */
+} init_graph_t;
+
+/**
+ * @brief Monotonic time in nanoseconds
+ */
+static uint64_t init_graph_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Find a step that can start, with the lock held
+ *
+ * @param graph Run
+ * @return Step number, count if none is ready
+ */
+static uint32_t init_graph_ready(const init_graph_t *graph) {
+    for (uint32_t i = 0; i < graph->count; i++) {
+        if (!(graph->started & INIT_AFTER(i)) && (graph->steps[i].after & ~graph->done) == 0) {
+            return i;
+        }
+    }
+    return graph->count;
+}
+
+/**
+ * @brief Run steps until none is left or one has failed
+ *
+ * @param arg Run
+ * @return NULL
+ */
+static void *init_graph_worker(void *arg) {
+    init_graph_t *graph = (init_graph_t *)arg;
+    uint64_t all = graph->count == 64 ? ~0ULL : INIT_AFTER(graph->count) - 1;
+
+    pthread_mutex_lock(&graph->lock);
+    for (;;) {
+        uint32_t i = graph->status == STATUS_SUCCESS ? init_graph_ready(graph) : graph->count;
+
+        if (i == graph->count) {
+            // Done, failed, or waiting for a running step to unlock more
+            if (graph->running == 0 || graph->done == all) {
+                break;
+            }
+            pthread_cond_wait(&graph->changed, &graph->lock);
+            continue;
+        }
+
+        graph->started |= INIT_AFTER(i);
+        graph->running++;
+        pthread_mutex_unlock(&graph->lock);
+
+        const init_step_t *step = &graph->steps[i];
+        uint64_t start = init_graph_now_ns();
+        status_t status = step->fn(step->arg);
+        uint64_t elapsed = init_graph_now_ns() - start;
+
+        if (status == STATUS_SUCCESS) {
+            LOG_INFO(LOG_CATEGORY_SYSTEM, "Init %s: %llu.%03llu ms", step->name,
+                     (unsigned long long)(elapsed / 1000000), (unsigned long long)(elapsed / 1000 % 1000));
+        } else {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Init %s failed: %d", step->name, status);
+        }
+
+        pthread_mutex_lock(&graph->lock);
+        graph->running--;
+        if (status == STATUS_SUCCESS) {
+            graph->done |= INIT_AFTER(i);
+        } else if (graph->status == STATUS_SUCCESS) {
+            graph->status = status;
+        }
+        graph->results[i].status = status;
+        graph->results[i].elapsed_ns = elapsed;
+        pthread_cond_broadcast(&graph->changed);
+    }
+    pthread_mutex_unlock(&graph->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Run startup steps
+ *
+ * @param steps Steps
+ * @param count Number of steps, at most INIT_GRAPH_MAX_STEPS
+ * @param threads Threads to use, 0 for one per CPU; the calling thread is one of them
+ * @param[out] results Outcome of every step, may be NULL
+ * @return STATUS_SUCCESS if every step succeeded, the status of the first
+ *         failed step otherwise, STATUS_INVALID_PARAMETER for a bad graph
+ */
+status_t init_graph_run(const init_step_t *steps, uint32_t count, uint32_t threads,
+                        init_step_result_t *results) {
+    init_graph_t graph;
+    init_step_result_t own_results[INIT_GRAPH_MAX_STEPS];
+    pthread_t helpers[INIT_GRAPH_MAX_STEPS];
+    uint32_t helper_count = 0;
+
+    if (!steps || count == 0 || count > INIT_GRAPH_MAX_STEPS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        // Only earlier steps, so the graph has no cycle
+        if (!steps[i].fn || (steps[i].after & ~(INIT_AFTER(i) - 1)) != 0) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Init step %u (%s) is invalid", i,
+                      steps[i].name ? steps[i].name : "?");
+            return STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (uint32_t)online : 1;
+    }
+    if (threads > count) {
+        threads = count;
+    }
+
+    memset(&graph, 0, sizeof(graph));
+    pthread_mutex_init(&graph.lock, NULL);
+    pthread_cond_init(&graph.changed, NULL);
+    graph.steps = steps;
+    graph.count = count;
+    graph.status = STATUS_SUCCESS;
+    graph.results = results ? results : own_results;
+    for (uint32_t i = 0; i < count; i++) {
+        graph.results[i].status = STATUS_NOT_EXECUTED;
+        graph.results[i].elapsed_ns = 0;
+    }
+
+    uint64_t start = init_graph_now_ns();
+
+    // Fewer helpers than asked for is only slower
+    while (helper_count + 1 < threads &&
+           pthread_create(&helpers[helper_count], NULL, init_graph_worker, &graph) == 0) {
+        helper_count++;
+    }
+    init_graph_worker(&graph);
+    for (uint32_t t = 0; t < helper_count; t++) {
+        pthread_join(helpers[t], NULL);
+    }
+
+    uint64_t elapsed = init_graph_now_ns() - start;
+    if (graph.status == STATUS_SUCCESS) {
+        uint64_t serial = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            serial += graph.results[i].elapsed_ns;
+        }
+        LOG_INFO(LOG_CATEGORY_SYSTEM, "Init: %u steps on %u threads in %llu ms (%llu ms one by one)",
+                 count, helper_count + 1, (unsigned long long)(elapsed / 1000000),
+                 (unsigned long long)(serial / 1000000));
+    }
+
+    pthread_cond_destroy(&graph.changed);
+    pthread_mutex_destroy(&graph.lock);
+    return graph.status;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file keyed_hash.c
+ * @brief Key of the table hashes
+ *
+ * The key comes from getrandom(). Should that fail, as in a sandbox
+ * without the system call, the clock, the process and an address stand
+ * in, which still keeps the key from being known in advance.
+ */
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/random.h>
+
+#include "../../include/common/keyed_hash.h"
+#include "../../include/common/config.h"
+#include "../../include/common/logging.h"
+
+keyed_hash_key_t g_keyed_hash_key;
+
+static pthread_once_t g_keyed_hash_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief splitmix64 step, to spread a seed over the key
+ */
+static uint64_t keyed_hash_mix(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static void keyed_hash_draw(void) {
+    keyed_hash_key_t key;
+    uint64_t state = CONFIG_KEYED_HASH_SEED;
+
+    if (state == 0 && getrandom(&key, sizeof(key), 0) == (ssize_t)sizeof(key)) {
+        g_keyed_hash_key = key;
+        return;
+    }
+
+    if (state == 0) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        state = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+        state ^= (uint64_t)getpid() << 32 ^ (uint64_t)(uintptr_t)&key;
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "getrandom() failed, table hash key taken from the clock");
+    }
+    g_keyed_hash_key.k0 = keyed_hash_mix(&state);
+    g_keyed_hash_key.k1 = keyed_hash_mix(&state);
+}
+
+void keyed_hash_init(void) {
+    pthread_once(&g_keyed_hash_once, keyed_hash_draw);
+}
@@ -0,0 +1,192 @@
+/**
+ * @file lock_stat.c
+ * @brief Lock class registry and contention report
+ *
+ * Classes live in a fixed array and are only ever added, so a lock keeps
+ * a plain pointer to its class and recording never looks anything up.
+ * Registration and the copies taken by readers run under one mutex;
+ * recording takes none.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../../include/common/lock_stat.h"
+
+static pthread_mutex_t g_lock_stat_mutex = PTHREAD_MUTEX_INITIALIZER;
+static lock_stat_class_t g_lock_stat_classes[LOCK_STAT_MAX_CLASSES];
+static uint32_t g_lock_stat_count;
+
+lock_stat_class_t *lock_stat_class(const char *name) {
+    lock_stat_class_t *cls = NULL;
+
+    if (!name) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_lock_stat_mutex);
+    for (uint32_t i = 0; i < g_lock_stat_count; i++) {
+        if (strncmp(g_lock_stat_classes[i].name, name, LOCK_STAT_NAME_MAX - 1) == 0) {
+            cls = &g_lock_stat_classes[i];
+            break;
+        }
+    }
+    if (!cls && g_lock_stat_count < LOCK_STAT_MAX_CLASSES) {
+        cls = &g_lock_stat_classes[g_lock_stat_count++];
+        snprintf(cls->name, sizeof(cls->name), "%s", name);
+    }
+    pthread_mutex_unlock(&g_lock_stat_mutex);
+
+    return cls;
+}
+
+/**
+ * @brief Copy the counters of a class word by word
+ */
+static void lock_stat_copy(lock_stat_class_t *dst, const lock_stat_class_t *src) {
+    memcpy(dst->name, src->name, sizeof(dst->name));
+    dst->acquisitions = __atomic_load_n(&src->acquisitions, __ATOMIC_RELAXED);
+    dst->contended = __atomic_load_n(&src->contended, __ATOMIC_RELAXED);
+    dst->spins = __atomic_load_n(&src->spins, __ATOMIC_RELAXED);
+    dst->wait_ns = __atomic_load_n(&src->wait_ns, __ATOMIC_RELAXED);
+    dst->hold_ns = __atomic_load_n(&src->hold_ns, __ATOMIC_RELAXED);
+    dst->wait_max_ns = __atomic_load_n(&src->wait_max_ns, __ATOMIC_RELAXED);
+    dst->hold_max_ns = __atomic_load_n(&src->hold_max_ns, __ATOMIC_RELAXED);
+    for (uint32_t b = 0; b < LOCK_STAT_BUCKETS; b++) {
+        dst->wait_hist[b] = __atomic_load_n(&src->wait_hist[b], __ATOMIC_RELAXED);
+        dst->hold_hist[b] = __atomic_load_n(&src->hold_hist[b], __ATOMIC_RELAXED);
+    }
+}
+
+uint32_t lock_stat_snapshot(lock_stat_class_t *classes, uint32_t max) {
+    uint32_t count;
+
+    if (!classes) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&g_lock_stat_mutex);
+    count = g_lock_stat_count < max ? g_lock_stat_count : max;
+    for (uint32_t i = 0; i < count; i++) {
+        lock_stat_copy(&classes[i], &g_lock_stat_classes[i]);
+    }
+    pthread_mutex_unlock(&g_lock_stat_mutex);
+
+    return count;
+}
+
+uint64_t lock_stat_percentile(const uint64_t *hist, double percentile) {
+    uint64_t total = 0;
+    uint64_t seen = 0;
+    uint64_t rank;
+
+    for (uint32_t b = 0; b < LOCK_STAT_BUCKETS; b++) {
+        total += hist[b];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    rank = (uint64_t)((double)total * percentile / 100.0);
+    if (rank >= total) {
+        rank = total - 1;
+    }
+    for (uint32_t b = 0; b < LOCK_STAT_BUCKETS; b++) {
+        seen += hist[b];
+        if (seen > rank) {
+            return b == 0 ? 0 : (1ULL << b) - 1;
+        }
+    }
+    return (1ULL << (LOCK_STAT_BUCKETS - 1)) - 1;
+}
+
+void lock_stat_clear(void) {
+    pthread_mutex_lock(&g_lock_stat_mutex);
+    for (uint32_t i = 0; i < g_lock_stat_count; i++) {
+        lock_stat_class_t *cls = &g_lock_stat_classes[i];
+        uint64_t *words = &cls->acquisitions;
+        size_t count = (sizeof(*cls) - offsetof(lock_stat_class_t, acquisitions)) / sizeof(uint64_t);
+
+        // Atomic stores, as lock holders may be counting at the same time
+        for (size_t w = 0; w < count; w++) {
+            __atomic_store_n(&words[w], 0, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&g_lock_stat_mutex);
+}
+
+/**
+ * @brief Percentile of a histogram, no more than the largest sample
+ */
+static uint64_t lock_stat_bounded(const uint64_t *hist, double percentile, uint64_t max) {
+    uint64_t value = lock_stat_percentile(hist, percentile);
+    return value < max ? value : max;
+}
+
+/**
+ * @brief Order classes by total wait, longest first
+ */
+static int lock_stat_compare(const void *a, const void *b) {
+    const lock_stat_class_t *x = (const lock_stat_class_t *)a;
+    const lock_stat_class_t *y = (const lock_stat_class_t *)b;
+
+    if (x->wait_ns != y->wait_ns) {
+        return x->wait_ns < y->wait_ns ? 1 : -1;
+    }
+    return strcmp(x->name, y->name);
+}
+
+size_t lock_stat_report(char *buf, size_t len) {
+    static lock_stat_class_t classes[LOCK_STAT_MAX_CLASSES];
+    static pthread_mutex_t report_mutex = PTHREAD_MUTEX_INITIALIZER;
+    uint32_t count;
+    size_t used = 0;
+    int n;
+
+    if (!buf || len == 0) {
+        return 0;
+    }
+    buf[0] = '\0';
+
+#define LOCK_STAT_APPEND(...)                                                   \
+    do {                                                                        \
+        n = snprintf(buf + (used < len ? used : len - 1),                       \
+                     used < len ? len - used : 1, __VA_ARGS__);                \
+        if (n > 0) {                                                            \
+            used += (size_t)n;                                                  \
+        }                                                                       \
+    } while (0)
+
+    pthread_mutex_lock(&report_mutex);
+    count = lock_stat_snapshot(classes, LOCK_STAT_MAX_CLASSES);
+    qsort(classes, count, sizeof(classes[0]), lock_stat_compare);
+
+    LOCK_STAT_APPEND("Lock contention, times in ns\n");
+    LOCK_STAT_APPEND("%-24s %12s %7s %10s %10s %10s %10s %10s %10s %10s\n", "class", "acquired",
+                     "cont%", "spins", "wait-avg", "wait-p99", "wait-max", "hold-avg", "hold-p99",
+                     "hold-max");
+    for (uint32_t i = 0; i < count; i++) {
+        const lock_stat_class_t *cls = &classes[i];
+
+        if (cls->acquisitions == 0) {
+            continue;
+        }
+        LOCK_STAT_APPEND("%-24s %12llu %6.2f%% %10llu %10llu %10llu %10llu %10llu %10llu %10llu\n",
+                         cls->name, (unsigned long long)cls->acquisitions,
+                         100.0 * (double)cls->contended / (double)cls->acquisitions,
+                         (unsigned long long)cls->spins,
+                         (unsigned long long)(cls->contended ? cls->wait_ns / cls->contended : 0),
+                         (unsigned long long)lock_stat_bounded(cls->wait_hist, 99.0, cls->wait_max_ns),
+                         (unsigned long long)cls->wait_max_ns,
+                         (unsigned long long)(cls->hold_ns / cls->acquisitions),
+                         (unsigned long long)lock_stat_bounded(cls->hold_hist, 99.0, cls->hold_max_ns),
+                         (unsigned long long)cls->hold_max_ns);
+    }
+    pthread_mutex_unlock(&report_mutex);
+
+#undef LOCK_STAT_APPEND
+
+    return used;
+}
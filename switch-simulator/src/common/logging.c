@@ -1,21 +1,33 @@
 /**
  * @file logging.c
  * @brief Logging system implementation for switch simulator
+ *
+ * Messages are written either synchronously by the caller or, in
+ * asynchronous mode, recorded raw into a lock-free ring of the calling
+ * thread and written by a background thread. A record holds the format
+ * and the arguments as words, with the bytes of %s strings inline; the
+ * writer thread walks the format again to print them.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <time.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include "../../include/common/logging.h"
+#include "../../include/common/config.h"
 
 /* Private variables */
 static FILE *g_log_file = NULL;
-static log_level_t g_global_log_level = LOG_LEVEL_INFO;
+static log_level_t g_global_log_level = (log_level_t)(LOG_LEVEL_ERROR + CONFIG_DEFAULT_LOG_LEVEL);
 static log_level_t g_category_levels[LOG_CATEGORY_COUNT];
+uint8_t g_log_thresholds[LOG_THRESHOLD_SLOTS] = {
+    [0 ... LOG_THRESHOLD_SLOTS - 1] = LOG_LEVEL_ERROR + CONFIG_DEFAULT_LOG_LEVEL
+};
 static pthread_mutex_t g_log_mutex;
 static bool g_initialized = false;
 
@@ -41,6 +53,250 @@ static const char *g_category_strings[] = {
     "TEST"
 };
 
+/* Same size as the message buffer of synchronous logging */
+#define LOG_MESSAGE_MAX         1024
+
+/* Asynchronous mode */
+#define LOG_ASYNC_MAX_RINGS     64      /* Threads with a ring; others log synchronously */
+#define LOG_ASYNC_RECORD_AVG    64      /* Expected bytes per record, for ring sizing */
+#define LOG_ASYNC_RECORD_MAX    512     /* Largest record, header included */
+#define LOG_ASYNC_IDLE_NS       1000000 /* Writer sleep when all rings are empty */
+
+/**
+ * @brief Header of a queued message; the argument stream follows it
+ */
+typedef struct {
+    uint32_t size;              /* Bytes of the record, a multiple of 8 */
+    uint8_t level;
+    uint8_t category;
+    uint8_t truncated;          /* Arguments did not all fit */
+    uint8_t reserved;
+    int32_t line;
+    uint32_t args_size;         /* Bytes of the argument stream */
+    uint64_t time_ns;           /* CLOCK_REALTIME when logged */
+    const char *file;
+    const char *func;
+    const char *format;
+} log_record_t;
+
+/**
+ * @brief Single-producer, single-consumer byte ring of one thread
+ */
+typedef struct {
+    uint64_t head __attribute__((aligned(64)));     /* Bytes written, by the producer */
+    uint64_t dropped;                               /* Messages refused, by the producer */
+    int writing;                                    /* Producer inside a record */
+    uint64_t tail __attribute__((aligned(64)));     /* Bytes read, by the writer thread */
+    uint64_t reported;                              /* Drops already reported */
+    bool in_use;                                    /* Owned by a live thread */
+    size_t mask;
+    uint8_t *data;
+} log_ring_t;
+
+static struct {
+    pthread_mutex_t lock;       /* Serializes mode changes and ring creation */
+    pthread_t thread;
+    bool running;               /* Producers may queue */
+    bool stop;                  /* Writer thread should exit */
+    log_ring_t *rings[LOG_ASYNC_MAX_RINGS];
+    uint32_t ring_count;
+    time_t stamp_sec;           /* Second of the cached timestamp */
+    char stamp[20];
+} g_async = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static __thread log_ring_t *t_log_ring;
+
+static pthread_once_t g_ring_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_ring_key;
+
+/**
+ * @brief Argument types, from the length modifier and conversion
+ */
+typedef enum {
+    LOG_ARG_NONE = 0,           /* Nothing consumed: %% or an unknown conversion */
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_SIZE,
+    LOG_ARG_PTRDIFF,
+    LOG_ARG_INTMAX,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_LDOUBLE,            /* Queued as a double */
+    LOG_ARG_STRING,
+    LOG_ARG_POINTER,
+    LOG_ARG_COUNT               /* %n, consumed and ignored */
+} log_arg_type_t;
+
+/**
+ * @brief One conversion of a format string
+ */
+typedef struct {
+    const char *start;          /* The '%' */
+    const char *end;            /* Past the conversion character */
+    uint8_t stars;              /* '*' width and precision arguments before the value */
+    uint8_t type;               /* log_arg_type_t */
+} log_spec_t;
+
+static void log_async_stop(void);
+
+/**
+ * @brief Find the next conversion in a format
+ *
+ * @param p Position in the format
+ * @param[out] spec Conversion found
+ * @return false if there is none
+ */
+static bool log_next_spec(const char *p, log_spec_t *spec)
+{
+    const char *q = strchr(p, '%');
+    int length = 0;     /* 'h', 'H' (hh), 'l', 'q' (ll), 'L', 'j', 'z', 't' */
+
+    if (!q) {
+        return false;
+    }
+    spec->start = q++;
+    spec->stars = 0;
+    spec->type = LOG_ARG_NONE;
+
+    while (*q && strchr("-+ #0'", *q)) {
+        q++;
+    }
+    if (*q == '*') {
+        spec->stars++;
+        q++;
+    } else {
+        while (*q >= '0' && *q <= '9') {
+            q++;
+        }
+    }
+    if (*q == '.') {
+        q++;
+        if (*q == '*') {
+            spec->stars++;
+            q++;
+        } else {
+            while (*q >= '0' && *q <= '9') {
+                q++;
+            }
+        }
+    }
+    if ((q[0] == 'h' || q[0] == 'l') && q[1] == q[0]) {
+        length = q[0] == 'h' ? 'H' : 'q';
+        q += 2;
+    } else if (*q && strchr("hlqLjzt", *q)) {
+        length = *q++;
+    }
+
+    switch (*q) {
+    case '\0':
+        spec->end = q;
+        return true;
+    case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+        switch (length) {
+        case 'l': spec->type = LOG_ARG_LONG; break;
+        case 'q': spec->type = LOG_ARG_LLONG; break;
+        case 'j': spec->type = LOG_ARG_INTMAX; break;
+        case 'z': spec->type = LOG_ARG_SIZE; break;
+        case 't': spec->type = LOG_ARG_PTRDIFF; break;
+        default: spec->type = LOG_ARG_INT; break;
+        }
+        break;
+    case 'c':
+        spec->type = LOG_ARG_INT;
+        break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        spec->type = length == 'L' ? LOG_ARG_LDOUBLE : LOG_ARG_DOUBLE;
+        break;
+    case 's':
+        // Wide strings are not copied; they print as their address
+        spec->type = length == 'l' ? LOG_ARG_POINTER : LOG_ARG_STRING;
+        break;
+    case 'p':
+        spec->type = LOG_ARG_POINTER;
+        break;
+    case 'n':
+        spec->type = LOG_ARG_COUNT;
+        break;
+    default:
+        break;
+    }
+    spec->end = q + 1;
+    return true;
+}
+
+/**
+ * @brief Write one formatted line; the caller holds g_log_mutex
+ */
+static void log_write_line(log_level_t level, log_category_t category, const char *timestamp,
+                           const char *file, int line, const char *func, const char *message)
+{
+    /* Get the filename without path */
+    const char *filename = file;
+    const char *last_slash = strrchr(file, '/');
+    if (last_slash) {
+        filename = last_slash + 1;
+    }
+
+    /* Format: timestamp | level | category | filename:line:function | message */
+    if (g_log_file) {
+        fprintf(g_log_file, "%s | %-7s | %-7s | %s:%d:%s | %s\n",
+                timestamp, log_level_to_string(level), log_category_to_string(category),
+                filename, line, func, message);
+    } else {
+        /* For console output, add colors based on log level */
+        const char *color_code = "";
+        const char *reset_code = "\033[0m";
+
+        switch (level) {
+            case LOG_LEVEL_FATAL:
+                color_code = "\033[1;31m"; /* Bold Red */
+                break;
+            case LOG_LEVEL_ERROR:
+                color_code = "\033[31m"; /* Red */
+                break;
+            case LOG_LEVEL_WARNING:
+                color_code = "\033[33m"; /* Yellow */
+                break;
+            case LOG_LEVEL_INFO:
+                color_code = "\033[32m"; /* Green */
+                break;
+            case LOG_LEVEL_DEBUG:
+                color_code = "\033[36m"; /* Cyan */
+                break;
+            case LOG_LEVEL_TRACE:
+                color_code = "\033[37m"; /* White */
+                break;
+        }
+
+        fprintf(stdout, "%s%s | %-7s | %-7s | %s:%d:%s | %s%s\n",
+                color_code, timestamp, log_level_to_string(level), log_category_to_string(category),
+                filename, line, func, message, reset_code);
+    }
+}
+
+/**
+ * @brief Flush the log output; the caller holds g_log_mutex
+ */
+static void log_flush_output(void)
+{
+    fflush(g_log_file ? g_log_file : stdout);
+}
+
+/**
+ * @brief Recompute g_log_thresholds from the global and category levels
+ */
+static void log_update_thresholds(void)
+{
+    for (int i = 0; i < LOG_THRESHOLD_SLOTS; i++) {
+        log_level_t level = g_global_log_level;
+
+        if (i < LOG_CATEGORY_COUNT && g_category_levels[i] > level) {
+            level = g_category_levels[i];
+        }
+        __atomic_store_n(&g_log_thresholds[i], (uint8_t)level, __ATOMIC_RELAXED);
+    }
+}
+
 /**
  * @brief Initialize logging system
  * 
@@ -71,13 +327,19 @@ status_t log_init(const char* log_file)
     for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
         g_category_levels[i] = g_global_log_level;
     }
+    log_update_thresholds();
     
     g_initialized = true;
     
+    if (CONFIG_ENABLE_ASYNC_LOGGING) {
+        /* Without the thread messages are written synchronously */
+        log_set_async(true);
+    }
+
     /* Log initialization message */
-    LOG_INFO(LOG_CATEGORY_SYSTEM, "Logging system initialized (level: %s, output: %s)",
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Logging system initialized (level: %s, output: %s%s)",
             log_level_to_string(g_global_log_level),
-            log_file ? log_file : "console");
+            log_file ? log_file : "console", log_is_async() ? ", asynchronous" : "");
     
     return STATUS_SUCCESS;
 }
@@ -92,6 +354,9 @@ status_t log_shutdown(void)
     if (!g_initialized) {
         return STATUS_SUCCESS; /* Not initialized */
     }
+
+    /* Write out what is queued while the output is still open */
+    log_async_stop();
     
     pthread_mutex_lock(&g_log_mutex);
     
@@ -122,6 +387,7 @@ void log_set_level(log_level_t level)
     
     pthread_mutex_lock(&g_log_mutex);
     g_global_log_level = level;
+    log_update_thresholds();
     pthread_mutex_unlock(&g_log_mutex);
     
     LOG_INFO(LOG_CATEGORY_SYSTEM, "Global log level changed to %s", 
@@ -142,12 +408,584 @@ void log_set_category_level(log_category_t category, log_level_t level)
     
     pthread_mutex_lock(&g_log_mutex);
     g_category_levels[category] = level;
+    log_update_thresholds();
     pthread_mutex_unlock(&g_log_mutex);
     
     LOG_INFO(LOG_CATEGORY_SYSTEM, "Log level for category %s changed to %s", 
             log_category_to_string(category), log_level_to_string(level));
 }
 
+/**
+ * @brief Release the ring of an exiting thread for the next one
+ */
+static void log_ring_thread_exit(void *arg)
+{
+    log_ring_t *ring = (log_ring_t *)arg;
+
+    __atomic_store_n(&ring->in_use, false, __ATOMIC_RELEASE);
+}
+
+static void log_ring_key_init(void)
+{
+    pthread_key_create(&g_ring_key, log_ring_thread_exit);
+}
+
+/**
+ * @brief Ring of the calling thread, claimed or created on first use
+ *
+ * Rings live as long as the process: a released ring is taken over,
+ * with anything still queued in it, by the next thread without one.
+ *
+ * @return Ring, or NULL if LOG_ASYNC_MAX_RINGS are in use or memory is short
+ */
+static log_ring_t *log_ring_local(void)
+{
+    log_ring_t *ring = t_log_ring;
+    uint32_t count;
+    size_t bytes = 1;
+
+    if (ring) {
+        return ring;
+    }
+    pthread_once(&g_ring_key_once, log_ring_key_init);
+
+    count = __atomic_load_n(&g_async.ring_count, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < count && !ring; i++) {
+        bool expected = false;
+
+        if (__atomic_compare_exchange_n(&g_async.rings[i]->in_use, &expected, true, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            ring = g_async.rings[i];
+        }
+    }
+
+    if (!ring) {
+        while (bytes < (size_t)CONFIG_LOG_BUFFER_SIZE * LOG_ASYNC_RECORD_AVG) {
+            bytes <<= 1;
+        }
+        pthread_mutex_lock(&g_async.lock);
+        if (g_async.ring_count < LOG_ASYNC_MAX_RINGS) {
+            ring = (log_ring_t *)aligned_alloc(64, sizeof(log_ring_t));
+            if (ring) {
+                memset(ring, 0, sizeof(*ring));
+                ring->data = (uint8_t *)malloc(bytes);
+                if (!ring->data) {
+                    free(ring);
+                    ring = NULL;
+                }
+            }
+            if (ring) {
+                ring->mask = bytes - 1;
+                ring->in_use = true;
+                g_async.rings[g_async.ring_count] = ring;
+                __atomic_store_n(&g_async.ring_count, g_async.ring_count + 1, __ATOMIC_RELEASE);
+            }
+        }
+        pthread_mutex_unlock(&g_async.lock);
+        if (!ring) {
+            return NULL;
+        }
+    }
+
+    pthread_setspecific(g_ring_key, ring);
+    t_log_ring = ring;
+    return ring;
+}
+
+/**
+ * @brief Copy bytes into a ring at a position, wrapping at its end
+ */
+static void log_ring_write(log_ring_t *ring, uint64_t pos, const void *src, size_t len)
+{
+    size_t off = (size_t)pos & ring->mask;
+    size_t first = ring->mask + 1 - off;
+
+    if (first > len) {
+        first = len;
+    }
+    memcpy(ring->data + off, src, first);
+    memcpy(ring->data, (const uint8_t *)src + first, len - first);
+}
+
+/**
+ * @brief Copy bytes out of a ring at a position, wrapping at its end
+ */
+static void log_ring_read(const log_ring_t *ring, uint64_t pos, void *dst, size_t len)
+{
+    size_t off = (size_t)pos & ring->mask;
+    size_t first = ring->mask + 1 - off;
+
+    if (first > len) {
+        first = len;
+    }
+    memcpy(dst, ring->data + off, first);
+    memcpy((uint8_t *)dst + first, ring->data, len - first);
+}
+
+/**
+ * @brief Queue a message in the ring of the calling thread
+ *
+ * @return false if the message must be written synchronously
+ */
+static bool log_async_record(log_level_t level, log_category_t category,
+                             const char *file, int line, const char *func,
+                             const char *format, va_list args)
+{
+    uint64_t buf[LOG_ASYNC_RECORD_MAX / sizeof(uint64_t)];
+    log_record_t *rec = (log_record_t *)buf;
+    uint8_t *stream = (uint8_t *)(rec + 1);
+    uint8_t *limit = (uint8_t *)buf + sizeof(buf);
+    uint8_t *pos = stream;
+    struct timespec ts;
+    log_spec_t spec;
+    const char *p = format;
+    log_ring_t *ring = log_ring_local();
+    uint64_t head;
+    va_list ap;
+
+    if (!ring) {
+        return false;
+    }
+
+    // Pairs with the writer-side check in log_async_stop()
+    __atomic_store_n(&ring->writing, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&g_async.running, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&ring->writing, 0, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    rec->level = (uint8_t)level;
+    rec->category = (uint8_t)category;
+    rec->truncated = 0;
+    rec->reserved = 0;
+    rec->line = line;
+    rec->time_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    rec->file = file;
+    rec->func = func;
+    rec->format = format;
+
+    va_copy(ap, args);
+    while (log_next_spec(p, &spec)) {
+        uint64_t word[3];
+        uint32_t words = 0;
+
+        p = spec.end;
+        if (spec.type == LOG_ARG_NONE) {
+            continue;
+        }
+        for (uint32_t s = 0; s < spec.stars; s++) {
+            word[words++] = (uint64_t)(int64_t)va_arg(ap, int);
+        }
+
+        switch (spec.type) {
+        case LOG_ARG_INT:
+            word[words++] = (uint64_t)(int64_t)va_arg(ap, int);
+            break;
+        case LOG_ARG_LONG:
+            word[words++] = (uint64_t)va_arg(ap, long);
+            break;
+        case LOG_ARG_LLONG:
+            word[words++] = (uint64_t)va_arg(ap, long long);
+            break;
+        case LOG_ARG_SIZE:
+            word[words++] = (uint64_t)va_arg(ap, size_t);
+            break;
+        case LOG_ARG_PTRDIFF:
+            word[words++] = (uint64_t)va_arg(ap, ptrdiff_t);
+            break;
+        case LOG_ARG_INTMAX:
+            word[words++] = (uint64_t)va_arg(ap, intmax_t);
+            break;
+        case LOG_ARG_DOUBLE:
+        case LOG_ARG_LDOUBLE: {
+            double d = spec.type == LOG_ARG_DOUBLE ? va_arg(ap, double) : (double)va_arg(ap, long double);
+            memcpy(&word[words++], &d, sizeof(d));
+            break;
+        }
+        case LOG_ARG_POINTER:
+        case LOG_ARG_COUNT:
+            word[words++] = (uint64_t)(uintptr_t)va_arg(ap, void *);
+            break;
+        case LOG_ARG_STRING: {
+            // Length word, then the bytes and a NUL, padded to a word
+            const char *str = va_arg(ap, const char *);
+            size_t room;
+            size_t len;
+
+            if (!str) {
+                str = "(null)";
+            }
+            if (pos + (words + 2) * sizeof(uint64_t) > limit) {
+                rec->truncated = 1;
+                goto done;
+            }
+            memcpy(pos, word, words * sizeof(uint64_t));
+            pos += words * sizeof(uint64_t);
+            room = (size_t)(limit - pos) - sizeof(uint64_t) - 1;
+            len = strnlen(str, room);
+            word[0] = len;
+            memcpy(pos, &word[0], sizeof(uint64_t));
+            pos += sizeof(uint64_t);
+            memcpy(pos, str, len);
+            pos[len] = '\0';
+            pos += (len + 1 + 7) & ~(size_t)7;
+            if (len == room) {
+                rec->truncated = 1;
+                goto done;
+            }
+            continue;
+        }
+        default:
+            break;
+        }
+
+        if (pos + words * sizeof(uint64_t) > limit) {
+            rec->truncated = 1;
+            goto done;
+        }
+        memcpy(pos, word, words * sizeof(uint64_t));
+        pos += words * sizeof(uint64_t);
+    }
+done:
+    va_end(ap);
+
+    rec->args_size = (uint32_t)(pos - stream);
+    rec->size = (uint32_t)(pos - (uint8_t *)buf);
+
+    head = ring->head;
+    if (head + rec->size - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->mask + 1) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+    } else {
+        log_ring_write(ring, head, buf, rec->size);
+        __atomic_store_n(&ring->head, head + rec->size, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&ring->writing, 0, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * @brief Print one queued conversion
+ *
+ * @return Bytes the conversion would take, as snprintf()
+ */
+static int log_print_spec(char *out, size_t left, const log_spec_t *spec,
+                          const uint64_t *stars, const void *value)
+{
+    char fmt[32];
+    size_t len = (size_t)(spec->end - spec->start);
+    uint64_t word = 0;
+    double d;
+    int n = 0;
+
+    if (len >= sizeof(fmt)) {
+        return snprintf(out, left, "%.*s", (int)len, spec->start);
+    }
+    if (spec->type == LOG_ARG_LDOUBLE) {
+        // Queued as a double: drop the 'L'
+        size_t j = 0;
+        for (size_t i = 0; i < len; i++) {
+            if (spec->start[i] != 'L') {
+                fmt[j++] = spec->start[i];
+            }
+        }
+        fmt[j] = '\0';
+    } else {
+        memcpy(fmt, spec->start, len);
+        fmt[len] = '\0';
+    }
+    if (spec->type != LOG_ARG_STRING) {
+        memcpy(&word, value, sizeof(word));
+    }
+    memcpy(&d, &word, sizeof(d));
+
+#define LOG_PRINT(arg)                                                                  \
+    do {                                                                                \
+        if (spec->stars == 0) {                                                         \
+            n = snprintf(out, left, fmt, arg);                                          \
+        } else if (spec->stars == 1) {                                                  \
+            n = snprintf(out, left, fmt, (int)stars[0], arg);                           \
+        } else {                                                                        \
+            n = snprintf(out, left, fmt, (int)stars[0], (int)stars[1], arg);            \
+        }                                                                               \
+    } while (0)
+
+    switch (spec->type) {
+    case LOG_ARG_INT:     LOG_PRINT((int)word); break;
+    case LOG_ARG_LONG:    LOG_PRINT((long)word); break;
+    case LOG_ARG_LLONG:   LOG_PRINT((long long)word); break;
+    case LOG_ARG_SIZE:    LOG_PRINT((size_t)word); break;
+    case LOG_ARG_PTRDIFF: LOG_PRINT((ptrdiff_t)word); break;
+    case LOG_ARG_INTMAX:  LOG_PRINT((intmax_t)word); break;
+    case LOG_ARG_DOUBLE:
+    case LOG_ARG_LDOUBLE: LOG_PRINT(d); break;
+    case LOG_ARG_STRING:  LOG_PRINT((const char *)value); break;
+    case LOG_ARG_POINTER:
+        if (spec->end[-1] == 's') {
+            // Wide string, queued as its address
+            n = snprintf(out, left, "%p", (void *)(uintptr_t)word);
+        } else {
+            LOG_PRINT((void *)(uintptr_t)word);
+        }
+        break;
+    default:
+        break;
+    }
+#undef LOG_PRINT
+
+    return n;
+}
+
+/**
+ * @brief Format the message of a queued record
+ */
+static void log_format_record(const log_record_t *rec, char *message, size_t size)
+{
+    const uint8_t *pos = (const uint8_t *)(rec + 1);
+    const uint8_t *end = pos + rec->args_size;
+    const char *p = rec->format;
+    size_t used = 0;
+    log_spec_t spec;
+    int n;
+
+#define LOG_ADVANCE(count)                                      \
+    do {                                                        \
+        if ((count) > 0) {                                      \
+            used += (size_t)(count);                            \
+            if (used >= size) {                                 \
+                used = size - 1;                                \
+            }                                                   \
+        }                                                       \
+    } while (0)
+
+    message[0] = '\0';
+    while (log_next_spec(p, &spec)) {
+        uint64_t stars[2];
+
+        n = snprintf(message + used, size - used, "%.*s", (int)(spec.start - p), p);
+        LOG_ADVANCE(n);
+        p = spec.end;
+
+        if (spec.type == LOG_ARG_NONE) {
+            if (spec.end - spec.start == 2 && spec.start[1] == '%') {
+                n = snprintf(message + used, size - used, "%%");
+            } else {
+                n = snprintf(message + used, size - used, "%.*s",
+                             (int)(spec.end - spec.start), spec.start);
+            }
+            LOG_ADVANCE(n);
+            continue;
+        }
+
+        // A record ends early when its arguments did not fit
+        if (pos + (spec.stars + 1) * sizeof(uint64_t) > end) {
+            n = snprintf(message + used, size - used, "...");
+            LOG_ADVANCE(n);
+            return;
+        }
+        memcpy(stars, pos, spec.stars * sizeof(uint64_t));
+        pos += spec.stars * sizeof(uint64_t);
+
+        if (spec.type == LOG_ARG_STRING) {
+            uint64_t len;
+
+            memcpy(&len, pos, sizeof(len));
+            pos += sizeof(len);
+            n = log_print_spec(message + used, size - used, &spec, stars, pos);
+            pos += (len + 1 + 7) & ~(uint64_t)7;
+        } else {
+            n = log_print_spec(message + used, size - used, &spec, stars, pos);
+            pos += sizeof(uint64_t);
+        }
+        if (spec.type != LOG_ARG_COUNT) {
+            LOG_ADVANCE(n);
+        }
+    }
+    n = snprintf(message + used, size - used, "%s%s", p, rec->truncated ? "..." : "");
+    LOG_ADVANCE(n);
+#undef LOG_ADVANCE
+}
+
+/**
+ * @brief Timestamp text of a record time, cached per second
+ */
+static const char *log_async_stamp(uint64_t time_ns)
+{
+    time_t sec = (time_t)(time_ns / 1000000000ULL);
+    struct tm timeinfo;
+
+    if (sec != g_async.stamp_sec || g_async.stamp[0] == '\0') {
+        localtime_r(&sec, &timeinfo);
+        strftime(g_async.stamp, sizeof(g_async.stamp), "%Y-%m-%d %H:%M:%S", &timeinfo);
+        g_async.stamp_sec = sec;
+    }
+    return g_async.stamp;
+}
+
+/**
+ * @brief Write every queued message, oldest first across the rings
+ *
+ * Runs on the writer thread, or on the thread that stops it once it has
+ * exited.
+ *
+ * @return Number of messages written
+ */
+static uint32_t log_async_drain(void)
+{
+    uint64_t buf[LOG_ASYNC_RECORD_MAX / sizeof(uint64_t)];
+    log_record_t *rec = (log_record_t *)buf;
+    char message[LOG_MESSAGE_MAX];
+    uint32_t written = 0;
+
+    for (;;) {
+        uint32_t count = __atomic_load_n(&g_async.ring_count, __ATOMIC_ACQUIRE);
+        log_ring_t *next = NULL;
+        uint64_t next_time = 0;
+
+        for (uint32_t i = 0; i < count; i++) {
+            log_ring_t *ring = g_async.rings[i];
+            uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+            uint64_t time_ns;
+
+            if (dropped != ring->reported) {
+                struct timespec ts;
+                char text[64];
+
+                clock_gettime(CLOCK_REALTIME, &ts);
+                snprintf(text, sizeof(text), "Log ring full, %llu messages dropped",
+                         (unsigned long long)(dropped - ring->reported));
+                ring->reported = dropped;
+                pthread_mutex_lock(&g_log_mutex);
+                log_write_line(LOG_LEVEL_WARNING, LOG_CATEGORY_SYSTEM,
+                               log_async_stamp((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec),
+                               __FILE__, __LINE__, __func__, text);
+                pthread_mutex_unlock(&g_log_mutex);
+            }
+
+            if (ring->tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+                continue;
+            }
+            log_ring_read(ring, ring->tail + offsetof(log_record_t, time_ns), &time_ns, sizeof(time_ns));
+            if (!next || time_ns < next_time) {
+                next = ring;
+                next_time = time_ns;
+            }
+        }
+        if (!next) {
+            break;
+        }
+
+        log_ring_read(next, next->tail, rec, sizeof(*rec));
+        log_ring_read(next, next->tail + sizeof(*rec), rec + 1, rec->size - sizeof(*rec));
+        __atomic_store_n(&next->tail, next->tail + rec->size, __ATOMIC_RELEASE);
+
+        log_format_record(rec, message, sizeof(message));
+        pthread_mutex_lock(&g_log_mutex);
+        log_write_line((log_level_t)rec->level, (log_category_t)rec->category,
+                       log_async_stamp(rec->time_ns), rec->file, rec->line, rec->func, message);
+        pthread_mutex_unlock(&g_log_mutex);
+        written++;
+    }
+
+    if (written) {
+        pthread_mutex_lock(&g_log_mutex);
+        log_flush_output();
+        pthread_mutex_unlock(&g_log_mutex);
+    }
+    return written;
+}
+
+/**
+ * @brief Writer thread: drain the rings, sleep while they are empty
+ */
+static void *log_async_thread(void *arg)
+{
+    const struct timespec idle = { 0, LOG_ASYNC_IDLE_NS };
+
+    (void)arg;
+    while (!__atomic_load_n(&g_async.stop, __ATOMIC_ACQUIRE)) {
+        if (log_async_drain() == 0) {
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Stop queueing, wait for the writer thread and write what is left
+ */
+static void log_async_stop(void)
+{
+    pthread_mutex_lock(&g_async.lock);
+    if (!g_async.running) {
+        pthread_mutex_unlock(&g_async.lock);
+        return;
+    }
+
+    __atomic_store_n(&g_async.running, false, __ATOMIC_SEQ_CST);
+    // A producer that saw the mode on finishes its record first
+    for (uint32_t i = 0; i < g_async.ring_count; i++) {
+        while (__atomic_load_n(&g_async.rings[i]->writing, __ATOMIC_SEQ_CST)) {
+            sched_yield();
+        }
+    }
+
+    __atomic_store_n(&g_async.stop, true, __ATOMIC_RELEASE);
+    pthread_join(g_async.thread, NULL);
+    log_async_drain();
+    pthread_mutex_unlock(&g_async.lock);
+}
+
+status_t log_set_async(bool enable)
+{
+    if (!g_initialized && log_init(NULL) != STATUS_SUCCESS) {
+        return STATUS_FAILURE;
+    }
+    if (!enable) {
+        log_async_stop();
+        return STATUS_SUCCESS;
+    }
+
+    pthread_mutex_lock(&g_async.lock);
+    if (!g_async.running) {
+        g_async.stop = false;
+        if (pthread_create(&g_async.thread, NULL, log_async_thread, NULL) != 0) {
+            pthread_mutex_unlock(&g_async.lock);
+            return STATUS_FAILURE;
+        }
+        __atomic_store_n(&g_async.running, true, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&g_async.lock);
+    return STATUS_SUCCESS;
+}
+
+bool log_is_async(void)
+{
+    return __atomic_load_n(&g_async.running, __ATOMIC_RELAXED);
+}
+
+void log_flush(void)
+{
+    const struct timespec pause = { 0, 100000 };
+    uint64_t heads[LOG_ASYNC_MAX_RINGS];
+    uint32_t count;
+
+    if (!log_is_async()) {
+        return;
+    }
+
+    count = __atomic_load_n(&g_async.ring_count, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < count; i++) {
+        heads[i] = __atomic_load_n(&g_async.rings[i]->head, __ATOMIC_ACQUIRE);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        while (__atomic_load_n(&g_async.rings[i]->tail, __ATOMIC_ACQUIRE) < heads[i] && log_is_async()) {
+            nanosleep(&pause, NULL);
+        }
+    }
+}
+
 /**
  * @brief Log a message
  * 
@@ -193,15 +1031,18 @@ void log_message_v(log_level_t level, log_category_t category,
     }
     
     /* Check log level filtering */
-    if (level > g_global_log_level && level > g_category_levels[category]) {
+    if (!log_level_enabled(level, category)) {
         return;
     }
     
-    /* Get the filename without path */
-    const char *filename = file;
-    const char *last_slash = strrchr(file, '/');
-    if (last_slash) {
-        filename = last_slash + 1;
+    /* Asynchronous mode: queue the raw message for the writer thread */
+    if (log_is_async()) {
+        if (level == LOG_LEVEL_FATAL) {
+            /* Written after everything queued before it */
+            log_flush();
+        } else if (log_async_record(level, category, file, line, func, format, args)) {
+            return;
+        }
     }
     
     /* Get current timestamp */
@@ -212,52 +1053,15 @@ void log_message_v(log_level_t level, log_category_t category,
     strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", timeinfo);
     
     /* Prepare log message buffer */
-    char message[1024];
+    char message[LOG_MESSAGE_MAX];
     va_list args_copy;
     va_copy(args_copy, args);
     vsnprintf(message, sizeof(message), format, args_copy);
     va_end(args_copy);
     
     pthread_mutex_lock(&g_log_mutex);
-    
-    /* Format: timestamp | level | category | filename:line:function | message */
-    if (g_log_file) {
-        fprintf(g_log_file, "%s | %-7s | %-7s | %s:%d:%s | %s\n",
-                timestamp, g_level_strings[level], g_category_strings[category],
-                filename, line, func, message);
-        fflush(g_log_file);
-    } else {
-        /* For console output, add colors based on log level */
-        const char *color_code = "";
-        const char *reset_code = "\033[0m";
-        
-        switch (level) {
-            case LOG_LEVEL_FATAL:
-                color_code = "\033[1;31m"; /* Bold Red */
-                break;
-            case LOG_LEVEL_ERROR:
-                color_code = "\033[31m"; /* Red */
-                break;
-            case LOG_LEVEL_WARNING:
-                color_code = "\033[33m"; /* Yellow */
-                break;
-            case LOG_LEVEL_INFO:
-                color_code = "\033[32m"; /* Green */
-                break;
-            case LOG_LEVEL_DEBUG:
-                color_code = "\033[36m"; /* Cyan */
-                break;
-            case LOG_LEVEL_TRACE:
-                color_code = "\033[37m"; /* White */
-                break;
-        }
-        
-        fprintf(stdout, "%s%s | %-7s | %-7s | %s:%d:%s | %s%s\n",
-                color_code, timestamp, g_level_strings[level], g_category_strings[category],
-                filename, line, func, message, reset_code);
-        fflush(stdout);
-    }
-    
+    log_write_line(level, category, timestamp, file, line, func, message);
+    log_flush_output();
     pthread_mutex_unlock(&g_log_mutex);
     
     /* For fatal errors, flush logs and potentially exit */
@@ -267,6 +1071,41 @@ void log_message_v(log_level_t level, log_category_t category,
     }
 }
 
+/**
+ * @brief Take a message from the token bucket of a call site
+ *
+ * Kept as the time the bucket will be full again (GCRA): a message is
+ * allowed while that is at most a burst of intervals ahead, and moves it
+ * one interval on.
+ *
+ * @param limit Rate limit of the site
+ * @param suppressed Messages refused since the last one allowed
+ * @return true if the message may be logged
+ */
+bool log_ratelimit(log_ratelimit_t *limit, uint32_t *suppressed)
+{
+    const uint64_t interval = (uint64_t)CONFIG_LOG_RATELIMIT_INTERVAL_MS * 1000000ULL;
+    const uint64_t window = interval * CONFIG_LOG_RATELIMIT_BURST;
+    struct timespec ts;
+    uint64_t now;
+    uint64_t next = __atomic_load_n(&limit->next_ns, __ATOMIC_RELAXED);
+    uint64_t want;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    now = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    do {
+        want = (next > now ? next : now) + interval;
+        if (want > now + window) {
+            __atomic_fetch_add(&limit->suppressed, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&limit->next_ns, &next, want, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    *suppressed = __atomic_exchange_n(&limit->suppressed, 0, __ATOMIC_RELAXED);
+    return true;
+}
+
 /**
  * @brief Get string representation of log level
  * 
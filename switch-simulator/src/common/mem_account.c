@@ -0,0 +1,232 @@
+/**
+ * @file mem_account.c
+ * @brief Per-subsystem heap counters and the memory report
+ *
+ * The wrappers charge malloc_usable_size() of each allocation to its tag,
+ * so freeing needs no header and no lookup. The high-water mark is raised
+ * with a compare-and-swap only when the bytes held pass it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#include "../../include/common/mem_account.h"
+#include "../../include/common/mem_arena.h"
+
+/**
+ * @brief Counters of a tag, on a cache line of their own
+ */
+typedef struct {
+    uint64_t bytes;
+    uint64_t objects;
+    uint64_t peak_bytes;
+    uint64_t allocations;
+    uint64_t failures;
+} __attribute__((aligned(64))) mem_tag_counters_t;
+
+static mem_tag_counters_t g_mem_tags[MEM_TAG_COUNT];
+
+static const char *const g_mem_tag_names[MEM_TAG_COUNT] = {
+    [MEM_TAG_OTHER] = "other",
+    [MEM_TAG_PACKET] = "packet",
+    [MEM_TAG_MAC_TABLE] = "mac_table",
+    [MEM_TAG_VLAN] = "vlan",
+    [MEM_TAG_FIB] = "fib",
+    [MEM_TAG_ARP] = "arp",
+    [MEM_TAG_IP] = "ip",
+    [MEM_TAG_ACL] = "acl",
+    [MEM_TAG_MPLS] = "mpls",
+    [MEM_TAG_CONNTRACK] = "conntrack",
+    [MEM_TAG_STATS] = "stats",
+    [MEM_TAG_MGMT] = "mgmt",
+};
+
+/**
+ * @brief Arenas whose usage is added to a tag, by arena name
+ */
+static const char *const g_mem_tag_arenas[MEM_TAG_COUNT] = {
+    [MEM_TAG_PACKET] = "packet_pool",
+    [MEM_TAG_MAC_TABLE] = "mac_table",
+    [MEM_TAG_FIB] = "fib",
+    [MEM_TAG_ARP] = "arp",
+};
+
+static inline mem_tag_counters_t *mem_tag_counters(mem_tag_t tag) {
+    return &g_mem_tags[(unsigned)tag < MEM_TAG_COUNT ? tag : MEM_TAG_OTHER];
+}
+
+static void mem_account_add(mem_tag_counters_t *ctr, size_t size) {
+    uint64_t bytes = __atomic_add_fetch(&ctr->bytes, size, __ATOMIC_RELAXED);
+    uint64_t peak = __atomic_load_n(&ctr->peak_bytes, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&ctr->objects, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ctr->allocations, 1, __ATOMIC_RELAXED);
+    while (bytes > peak &&
+           !__atomic_compare_exchange_n(&ctr->peak_bytes, &peak, bytes, true, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)) {
+    }
+}
+
+static void mem_account_sub(mem_tag_counters_t *ctr, size_t size) {
+    __atomic_fetch_sub(&ctr->bytes, size, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&ctr->objects, 1, __ATOMIC_RELAXED);
+}
+
+void *mem_malloc(mem_tag_t tag, size_t size) {
+    mem_tag_counters_t *ctr = mem_tag_counters(tag);
+    void *ptr = malloc(size);
+
+    if (!ptr) {
+        __atomic_fetch_add(&ctr->failures, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    mem_account_add(ctr, malloc_usable_size(ptr));
+    return ptr;
+}
+
+void *mem_calloc(mem_tag_t tag, size_t count, size_t size) {
+    mem_tag_counters_t *ctr = mem_tag_counters(tag);
+    void *ptr = calloc(count, size);
+
+    if (!ptr) {
+        __atomic_fetch_add(&ctr->failures, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    mem_account_add(ctr, malloc_usable_size(ptr));
+    return ptr;
+}
+
+void *mem_aligned_alloc(mem_tag_t tag, size_t align, size_t size) {
+    mem_tag_counters_t *ctr = mem_tag_counters(tag);
+    void *ptr;
+
+    if (posix_memalign(&ptr, align, size) != 0) {
+        __atomic_fetch_add(&ctr->failures, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    mem_account_add(ctr, malloc_usable_size(ptr));
+    return ptr;
+}
+
+void *mem_realloc(mem_tag_t tag, void *ptr, size_t size) {
+    mem_tag_counters_t *ctr = mem_tag_counters(tag);
+    size_t old_size = ptr ? malloc_usable_size(ptr) : 0;
+    void *new_ptr = realloc(ptr, size);
+
+    if (!new_ptr) {
+        if (size != 0 || !ptr) {
+            __atomic_fetch_add(&ctr->failures, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        // realloc(ptr, 0) freed the memory
+        mem_account_sub(ctr, old_size);
+        return NULL;
+    }
+    if (ptr) {
+        mem_account_sub(ctr, old_size);
+    }
+    mem_account_add(ctr, malloc_usable_size(new_ptr));
+    return new_ptr;
+}
+
+void mem_free(mem_tag_t tag, void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    mem_account_sub(mem_tag_counters(tag), malloc_usable_size(ptr));
+    free(ptr);
+}
+
+const char *mem_tag_name(mem_tag_t tag) {
+    return (unsigned)tag < MEM_TAG_COUNT ? g_mem_tag_names[tag] : "unknown";
+}
+
+status_t mem_account_get(mem_tag_t tag, mem_account_stats_t *stats) {
+    const mem_tag_counters_t *ctr;
+    mem_arena_stats_t arena;
+
+    if ((unsigned)tag >= MEM_TAG_COUNT || !stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    ctr = &g_mem_tags[tag];
+    memset(stats, 0, sizeof(*stats));
+    stats->heap_bytes = __atomic_load_n(&ctr->bytes, __ATOMIC_RELAXED);
+    stats->heap_objects = __atomic_load_n(&ctr->objects, __ATOMIC_RELAXED);
+    stats->heap_peak_bytes = __atomic_load_n(&ctr->peak_bytes, __ATOMIC_RELAXED);
+    stats->allocations = __atomic_load_n(&ctr->allocations, __ATOMIC_RELAXED);
+    stats->failures = __atomic_load_n(&ctr->failures, __ATOMIC_RELAXED);
+
+    if (g_mem_tag_arenas[tag] &&
+        mem_arena_get_stats_by_name(g_mem_tag_arenas[tag], &arena) == STATUS_SUCCESS) {
+        stats->arena_used_bytes = arena.used_bytes;
+        stats->arena_peak_bytes = arena.peak_used_bytes;
+        stats->arena_mapped_bytes = arena.mapped_bytes;
+    }
+    return STATUS_SUCCESS;
+}
+
+void mem_account_reset_peaks(void) {
+    for (uint32_t t = 0; t < MEM_TAG_COUNT; t++) {
+        __atomic_store_n(&g_mem_tags[t].peak_bytes, __atomic_load_n(&g_mem_tags[t].bytes, __ATOMIC_RELAXED),
+                         __ATOMIC_RELAXED);
+    }
+    mem_arena_reset_peaks();
+}
+
+size_t mem_account_report(char *buf, size_t len) {
+    mem_account_stats_t total;
+    size_t used = 0;
+    int n;
+
+    if (!buf || len == 0) {
+        return 0;
+    }
+    buf[0] = '\0';
+
+#define MEM_ACCOUNT_APPEND(...)                                                 \
+    do {                                                                        \
+        n = snprintf(buf + (used < len ? used : len - 1),                       \
+                     used < len ? len - used : 1, __VA_ARGS__);                \
+        if (n > 0) {                                                            \
+            used += (size_t)n;                                                  \
+        }                                                                       \
+    } while (0)
+
+    memset(&total, 0, sizeof(total));
+    MEM_ACCOUNT_APPEND("Memory by subsystem, in bytes\n");
+    MEM_ACCOUNT_APPEND("%-10s %12s %9s %12s %12s %8s %12s %12s %12s\n", "subsystem", "heap", "objects",
+                       "heap-peak", "allocs", "failed", "arena", "arena-peak", "arena-mapped");
+    for (uint32_t t = 0; t < MEM_TAG_COUNT; t++) {
+        mem_account_stats_t stats;
+
+        mem_account_get((mem_tag_t)t, &stats);
+        if (stats.allocations == 0 && stats.failures == 0 && stats.arena_mapped_bytes == 0 &&
+            stats.arena_peak_bytes == 0) {
+            continue;
+        }
+        MEM_ACCOUNT_APPEND("%-10s %12llu %9llu %12llu %12llu %8llu %12llu %12llu %12llu\n",
+                           mem_tag_name((mem_tag_t)t), (unsigned long long)stats.heap_bytes,
+                           (unsigned long long)stats.heap_objects, (unsigned long long)stats.heap_peak_bytes,
+                           (unsigned long long)stats.allocations, (unsigned long long)stats.failures,
+                           (unsigned long long)stats.arena_used_bytes, (unsigned long long)stats.arena_peak_bytes,
+                           (unsigned long long)stats.arena_mapped_bytes);
+        total.heap_bytes += stats.heap_bytes;
+        total.heap_objects += stats.heap_objects;
+        total.allocations += stats.allocations;
+        total.failures += stats.failures;
+        total.arena_used_bytes += stats.arena_used_bytes;
+        total.arena_mapped_bytes += stats.arena_mapped_bytes;
+    }
+    MEM_ACCOUNT_APPEND("%-10s %12llu %9llu %12s %12llu %8llu %12llu %12s %12llu\n", "total",
+                       (unsigned long long)total.heap_bytes, (unsigned long long)total.heap_objects, "-",
+                       (unsigned long long)total.allocations, (unsigned long long)total.failures,
+                       (unsigned long long)total.arena_used_bytes, "-",
+                       (unsigned long long)total.arena_mapped_bytes);
+
+#undef MEM_ACCOUNT_APPEND
+
+    return used;
+}
@@ -0,0 +1,443 @@
+/**
+ * @file mem_arena.c
+ * @brief Huge-page backed memory arena implementation
+ *
+ * Block descriptors live on the heap, apart from the memory they describe,
+ * so every mapping is whole huge pages of table data.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../../include/common/mem_arena.h"
+#include "../../include/common/config.h"
+#include "../../include/common/logging.h"
+
+#define MEM_ARENA_2MB           ((size_t)2 << 20)
+#define MEM_ARENA_1GB           ((size_t)1 << 30)
+#define MEM_ARENA_MIN_ALIGN     16
+
+/* Page size flags of MAP_HUGETLB, without relying on recent headers */
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT          26
+#endif
+#define MEM_ARENA_MAP_HUGE_2MB  (21 << MAP_HUGE_SHIFT)
+#define MEM_ARENA_MAP_HUGE_1GB  (30 << MAP_HUGE_SHIFT)
+
+/**
+ * @brief How a block is backed
+ */
+typedef enum {
+    MEM_ARENA_PAGES = 0,        /**< Normal pages */
+    MEM_ARENA_THP,              /**< Offered to transparent huge pages */
+    MEM_ARENA_HUGETLB           /**< Explicit huge pages */
+} mem_arena_backing_t;
+
+/**
+ * @brief One mapping of an arena
+ */
+typedef struct mem_arena_block {
+    struct mem_arena_block *next;
+    uint8_t *base;              /**< Start of the mapping, 2MB aligned */
+    size_t size;                /**< Bytes mapped */
+    size_t used;                /**< Bytes bumped past */
+    uint32_t live;              /**< Allocations not freed yet */
+    size_t page_size;           /**< Page size of the mapping */
+    mem_arena_backing_t backing;
+} mem_arena_block_t;
+
+struct mem_arena {
+    struct mem_arena *next;     /**< Next arena of the registry */
+    char name[MEM_ARENA_NAME_LEN];
+    pthread_mutex_t lock;
+    mem_arena_block_t *blocks;  /**< Every mapping */
+    mem_arena_block_t *current; /**< Block allocations are bumped from, NULL for none */
+    uint64_t used_bytes;
+    uint64_t peak_used_bytes;
+    uint64_t allocations;
+    uint64_t hugetlb_fallbacks;
+};
+
+/**
+ * @brief Every arena, for the statistics by name
+ */
+static struct {
+    pthread_mutex_t lock;
+    mem_arena_t *arenas;
+} g_arenas = { PTHREAD_MUTEX_INITIALIZER, NULL };
+
+/**
+ * @brief Map a block
+ *
+ * @param arena Arena, for the fallback counter
+ * @param size Bytes, a multiple of 2MB
+ * @return Block, NULL on failure
+ */
+static mem_arena_block_t *mem_arena_map(mem_arena_t *arena, size_t size) {
+    mem_arena_block_t *block = (mem_arena_block_t *)calloc(1, sizeof(mem_arena_block_t));
+    void *addr = MAP_FAILED;
+
+    if (!block) {
+        return NULL;
+    }
+
+#if CONFIG_MEM_ARENA_HUGETLB
+    if (size % MEM_ARENA_1GB == 0) {
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MEM_ARENA_MAP_HUGE_1GB, -1, 0);
+        block->page_size = MEM_ARENA_1GB;
+    }
+    if (addr == MAP_FAILED) {
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MEM_ARENA_MAP_HUGE_2MB, -1, 0);
+        block->page_size = MEM_ARENA_2MB;
+    }
+    if (addr != MAP_FAILED) {
+        block->backing = MEM_ARENA_HUGETLB;
+    } else {
+        arena->hugetlb_fallbacks++;
+    }
+#endif
+
+    if (addr == MAP_FAILED) {
+        // Map 2MB more than needed and trim, so the block starts on a huge page
+        uint8_t *raw = (uint8_t *)mmap(NULL, size + MEM_ARENA_2MB, PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            free(block);
+            return NULL;
+        }
+
+        uint8_t *start = (uint8_t *)(((uintptr_t)raw + MEM_ARENA_2MB - 1) & ~(uintptr_t)(MEM_ARENA_2MB - 1));
+        if (start > raw) {
+            munmap(raw, (size_t)(start - raw));
+        }
+        if (start + size < raw + size + MEM_ARENA_2MB) {
+            munmap(start + size, (size_t)(raw + size + MEM_ARENA_2MB - (start + size)));
+        }
+        addr = start;
+
+#ifdef MADV_HUGEPAGE
+        if (madvise(addr, size, MADV_HUGEPAGE) == 0) {
+            block->backing = MEM_ARENA_THP;
+            block->page_size = MEM_ARENA_2MB;
+        } else
+#endif
+        {
+            block->backing = MEM_ARENA_PAGES;
+            block->page_size = (size_t)sysconf(_SC_PAGESIZE);
+        }
+    }
+
+    block->base = (uint8_t *)addr;
+    block->size = size;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    return block;
+}
+
+/**
+ * @brief Unlink and unmap a block
+ *
+ * @param arena Arena, locked
+ * @param block Block of the arena
+ */
+static void mem_arena_unmap(mem_arena_t *arena, mem_arena_block_t *block) {
+    mem_arena_block_t **link = &arena->blocks;
+
+    while (*link != block) {
+        link = &(*link)->next;
+    }
+    *link = block->next;
+    if (arena->current == block) {
+        arena->current = NULL;
+    }
+
+    munmap(block->base, block->size);
+    free(block);
+}
+
+/**
+ * @brief Allocate an arena that is not listed yet
+ *
+ * @param name Arena name
+ * @return Arena, NULL on failure
+ */
+static mem_arena_t *mem_arena_new(const char *name) {
+    mem_arena_t *arena = (mem_arena_t *)calloc(1, sizeof(mem_arena_t));
+
+    if (!arena) {
+        return NULL;
+    }
+    strncpy(arena->name, name, sizeof(arena->name) - 1);
+    pthread_mutex_init(&arena->lock, NULL);
+    return arena;
+}
+
+/**
+ * @brief Create an arena
+ *
+ * @param name Name the arena is reported by; arenas may share a name
+ * @return Arena, NULL on failure
+ */
+mem_arena_t *mem_arena_create(const char *name) {
+    mem_arena_t *arena = name ? mem_arena_new(name) : NULL;
+
+    if (!arena) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_arenas.lock);
+    arena->next = g_arenas.arenas;
+    g_arenas.arenas = arena;
+    pthread_mutex_unlock(&g_arenas.lock);
+
+    return arena;
+}
+
+/**
+ * @brief Get the arena of a name, creating it on first use
+ *
+ * @param name Arena name
+ * @return Arena, NULL on failure
+ */
+mem_arena_t *mem_arena_get(const char *name) {
+    mem_arena_t *arena;
+
+    if (!name) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_arenas.lock);
+    for (arena = g_arenas.arenas; arena; arena = arena->next) {
+        if (strncmp(arena->name, name, sizeof(arena->name) - 1) == 0) {
+            break;
+        }
+    }
+    if (!arena) {
+        arena = mem_arena_new(name);
+        if (arena) {
+            arena->next = g_arenas.arenas;
+            g_arenas.arenas = arena;
+        }
+    }
+    pthread_mutex_unlock(&g_arenas.lock);
+
+    return arena;
+}
+
+/**
+ * @brief Destroy an arena and unmap all its memory
+ *
+ * @param arena Arena, may be NULL
+ */
+void mem_arena_destroy(mem_arena_t *arena) {
+    mem_arena_t **link;
+
+    if (!arena) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_arenas.lock);
+    for (link = &g_arenas.arenas; *link; link = &(*link)->next) {
+        if (*link == arena) {
+            *link = arena->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_arenas.lock);
+
+    while (arena->blocks) {
+        mem_arena_unmap(arena, arena->blocks);
+    }
+    pthread_mutex_destroy(&arena->lock);
+    free(arena);
+}
+
+/**
+ * @brief Allocate zeroed memory
+ *
+ * @param arena Arena
+ * @param size Bytes
+ * @param align Alignment, a power of two up to 2MB; 0 for 16
+ * @return Memory, NULL on failure
+ */
+void *mem_arena_alloc(mem_arena_t *arena, size_t size, size_t align) {
+    mem_arena_block_t *block;
+    size_t offset;
+
+    if (align == 0) {
+        align = MEM_ARENA_MIN_ALIGN;
+    }
+    if (!arena || size == 0 || (align & (align - 1)) != 0 || align > MEM_ARENA_2MB ||
+        size > SIZE_MAX - MEM_ARENA_1GB) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&arena->lock);
+
+    if (size > CONFIG_MEM_ARENA_BLOCK_SIZE / 2) {
+        // A mapping of its own, in whole gigabytes when that wastes little
+        size_t mapped = (size + MEM_ARENA_2MB - 1) & ~(MEM_ARENA_2MB - 1);
+        size_t gigs = (size + MEM_ARENA_1GB - 1) & ~(MEM_ARENA_1GB - 1);
+        if (size >= MEM_ARENA_1GB && gigs - size < gigs / 8) {
+            mapped = gigs;
+        }
+
+        block = mem_arena_map(arena, mapped);
+        offset = 0;
+    } else {
+        block = arena->current;
+        offset = block ? (block->used + align - 1) & ~(align - 1) : 0;
+        if (!block || offset + size > block->size) {
+            block = mem_arena_map(arena, CONFIG_MEM_ARENA_BLOCK_SIZE);
+            arena->current = block;
+            offset = 0;
+        }
+    }
+
+    if (!block) {
+        pthread_mutex_unlock(&arena->lock);
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Arena %s: failed to map memory for %zu bytes", arena->name, size);
+        return NULL;
+    }
+
+    block->used = offset + size;
+    block->live++;
+    arena->used_bytes += size;
+    if (arena->used_bytes > arena->peak_used_bytes) {
+        arena->peak_used_bytes = arena->used_bytes;
+    }
+    arena->allocations++;
+
+    pthread_mutex_unlock(&arena->lock);
+    return block->base + offset;
+}
+
+/**
+ * @brief Free memory of mem_arena_alloc()
+ *
+ * @param arena Arena the memory came from
+ * @param ptr Memory, may be NULL
+ * @param size Bytes given to mem_arena_alloc()
+ */
+void mem_arena_free(mem_arena_t *arena, void *ptr, size_t size) {
+    mem_arena_block_t *block;
+
+    if (!arena || !ptr) {
+        return;
+    }
+
+    pthread_mutex_lock(&arena->lock);
+    for (block = arena->blocks; block; block = block->next) {
+        if ((uint8_t *)ptr >= block->base && (uint8_t *)ptr < block->base + block->size) {
+            break;
+        }
+    }
+
+    if (block) {
+        arena->used_bytes -= size;
+        if (--block->live == 0) {
+            mem_arena_unmap(arena, block);
+        }
+    } else {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Arena %s: freeing memory it does not hold", arena->name);
+    }
+    pthread_mutex_unlock(&arena->lock);
+}
+
+/**
+ * @brief Add the usage of an arena to statistics
+ *
+ * @param arena Arena
+ * @param stats Statistics to add to
+ */
+static void mem_arena_add_stats(mem_arena_t *arena, mem_arena_stats_t *stats) {
+    const mem_arena_block_t *block;
+
+    pthread_mutex_lock(&arena->lock);
+    for (block = arena->blocks; block; block = block->next) {
+        stats->blocks++;
+        stats->mapped_bytes += block->size;
+        if (block->backing == MEM_ARENA_HUGETLB) {
+            stats->hugetlb_bytes += block->size;
+        } else if (block->backing == MEM_ARENA_THP) {
+            stats->thp_bytes += block->size;
+        }
+        if (block->page_size > stats->page_size) {
+            stats->page_size = block->page_size;
+        }
+    }
+    stats->arenas++;
+    stats->used_bytes += arena->used_bytes;
+    stats->peak_used_bytes += arena->peak_used_bytes;
+    stats->allocations += arena->allocations;
+    stats->hugetlb_fallbacks += arena->hugetlb_fallbacks;
+    pthread_mutex_unlock(&arena->lock);
+}
+
+/**
+ * @brief Get the usage of an arena
+ *
+ * @param arena Arena
+ * @param[out] stats Usage
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER for NULL arguments
+ */
+status_t mem_arena_get_stats(mem_arena_t *arena, mem_arena_stats_t *stats) {
+    if (!arena || !stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    memcpy(stats->name, arena->name, sizeof(stats->name));
+    mem_arena_add_stats(arena, stats);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the usage of every arena of one name, summed
+ *
+ * @param name Arena name
+ * @param[out] stats Usage
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if no arena has the name,
+ *         STATUS_INVALID_PARAMETER for NULL arguments
+ */
+status_t mem_arena_get_stats_by_name(const char *name, mem_arena_stats_t *stats) {
+    mem_arena_t *arena;
+
+    if (!name || !stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    strncpy(stats->name, name, sizeof(stats->name) - 1);
+
+    pthread_mutex_lock(&g_arenas.lock);
+    for (arena = g_arenas.arenas; arena; arena = arena->next) {
+        if (strcmp(arena->name, stats->name) == 0) {
+            mem_arena_add_stats(arena, stats);
+        }
+    }
+    pthread_mutex_unlock(&g_arenas.lock);
+
+    return stats->arenas ? STATUS_SUCCESS : STATUS_NOT_FOUND;
+}
+
+/**
+ * @brief Restart the high-water mark of every arena from its usage now
+ */
+void mem_arena_reset_peaks(void) {
+    mem_arena_t *arena;
+
+    pthread_mutex_lock(&g_arenas.lock);
+    for (arena = g_arenas.arenas; arena; arena = arena->next) {
+        pthread_mutex_lock(&arena->lock);
+        arena->peak_used_bytes = arena->used_bytes;
+        pthread_mutex_unlock(&arena->lock);
+    }
+    pthread_mutex_unlock(&g_arenas.lock);
+}
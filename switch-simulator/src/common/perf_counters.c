@@ -0,0 +1,228 @@
+/**
+ * @file perf_counters.c
+ * @brief Hardware performance counters through perf_event_open(2)
+ *
+ * All events of a thread are one group, so a single read() returns them
+ * counted over the same interval. Each event that opens is added to the
+ * group on its own; one the CPU does not have is left out rather than
+ * failing the group.
+ */
+
+#include "../../include/common/perf_counters.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "../../include/common/logging.h"
+
+static const char *const g_counter_names[PERF_COUNTER_COUNT] = {
+    [PERF_COUNTER_CYCLES]       = "cycles",
+    [PERF_COUNTER_INSTRUCTIONS] = "instructions",
+    [PERF_COUNTER_CACHE_MISSES] = "llc-misses",
+    [PERF_COUNTER_BRANCH_MISSES] = "branch-misses",
+    [PERF_COUNTER_DTLB_MISSES]  = "dtlb-misses",
+};
+
+static pthread_once_t g_thread_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_thread_key;
+
+/* Per thread: the group, and whether opening it was tried */
+static __thread perf_counters_t t_counters;
+static __thread bool t_tried;
+
+const char *perf_counter_name(perf_counter_t counter) {
+    return counter < PERF_COUNTER_COUNT ? g_counter_names[counter] : "unknown";
+}
+
+#ifdef __linux__
+
+static int perf_open_event(perf_counter_t counter, int group_fd) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = group_fd < 0;   /* The leader starts the group once it is complete */
+
+    switch (counter) {
+        case PERF_COUNTER_CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_COUNTER_INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_COUNTER_CACHE_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PERF_COUNTER_BRANCH_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case PERF_COUNTER_DTLB_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        default:
+            return -1;
+    }
+
+    /* This thread, any CPU */
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+status_t perf_counters_open(perf_counters_t *pc) {
+    if (!pc) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(pc, 0, sizeof(*pc));
+    pc->leader = -1;
+    for (uint32_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+        pc->fds[i] = -1;
+    }
+
+    for (uint32_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+        int fd = perf_open_event((perf_counter_t)i, pc->leader);
+        if (fd < 0) {
+            continue;
+        }
+        if (pc->leader < 0) {
+            pc->leader = fd;
+        }
+        pc->fds[i] = fd;
+        pc->slot[i] = (uint8_t)pc->nr++;
+        pc->mask |= 1u << i;
+    }
+
+    if (pc->leader < 0) {
+        LOG_DEBUG(LOG_CATEGORY_SYSTEM, "No hardware performance counters available");
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    ioctl(pc->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(pc->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return STATUS_SUCCESS;
+}
+
+void perf_counters_close(perf_counters_t *pc) {
+    if (!pc) {
+        return;
+    }
+    for (uint32_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (pc->fds[i] >= 0) {
+            close(pc->fds[i]);
+            pc->fds[i] = -1;
+        }
+    }
+    pc->leader = -1;
+    pc->nr = 0;
+    pc->mask = 0;
+}
+
+status_t perf_counters_read(const perf_counters_t *pc, perf_sample_t *sample) {
+    /* PERF_FORMAT_GROUP layout: nr, time enabled, time running, then one value per event */
+    uint64_t buf[3 + PERF_COUNTER_COUNT];
+    ssize_t want;
+
+    if (!pc || !sample) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    memset(sample, 0, sizeof(*sample));
+    if (pc->leader < 0) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    want = (ssize_t)((3 + pc->nr) * sizeof(uint64_t));
+    if (read(pc->leader, buf, (size_t)want) != want) {
+        return STATUS_FAILURE;
+    }
+    if (buf[2] == 0) {
+        return STATUS_RESOURCE_UNAVAILABLE;
+    }
+
+    /* Scale up if the group shared the PMU with others part of the time */
+    double scale = buf[2] < buf[1] ? (double)buf[1] / (double)buf[2] : 1.0;
+    for (uint32_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (pc->mask & (1u << i)) {
+            uint64_t value = buf[3 + pc->slot[i]];
+            sample->values[i] = scale == 1.0 ? value : (uint64_t)((double)value * scale);
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+#else /* !__linux__ */
+
+status_t perf_counters_open(perf_counters_t *pc) {
+    if (!pc) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    memset(pc, 0, sizeof(*pc));
+    pc->leader = -1;
+    for (uint32_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+        pc->fds[i] = -1;
+    }
+    return STATUS_NOT_SUPPORTED;
+}
+
+void perf_counters_close(perf_counters_t *pc) {
+    (void)pc;
+}
+
+status_t perf_counters_read(const perf_counters_t *pc, perf_sample_t *sample) {
+    if (!pc || !sample) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    memset(sample, 0, sizeof(*sample));
+    return STATUS_NOT_SUPPORTED;
+}
+
+#endif /* __linux__ */
+
+/**
+ * @brief Close the group of an exiting thread
+ */
+static void perf_thread_exit(void *arg) {
+    perf_counters_close(arg);
+}
+
+static void perf_make_thread_key(void) {
+    pthread_key_create(&g_thread_key, perf_thread_exit);
+}
+
+perf_counters_t *perf_counters_thread(void) {
+    if (!t_tried) {
+        t_tried = true;
+        if (perf_counters_open(&t_counters) == STATUS_SUCCESS) {
+            pthread_once(&g_thread_key_once, perf_make_thread_key);
+            pthread_setspecific(g_thread_key, &t_counters);
+        }
+    }
+    return t_counters.leader >= 0 ? &t_counters : NULL;
+}
+
+const char *perf_sample_bound(const perf_sample_t *sample) {
+    uint64_t instructions;
+    uint64_t misses;
+
+    if (!sample || (instructions = sample->values[PERF_COUNTER_INSTRUCTIONS]) == 0) {
+        return "unknown";
+    }
+    misses = sample->values[PERF_COUNTER_CACHE_MISSES] > sample->values[PERF_COUNTER_DTLB_MISSES] ?
+             sample->values[PERF_COUNTER_CACHE_MISSES] : sample->values[PERF_COUNTER_DTLB_MISSES];
+    return misses * 1000 >= (uint64_t)CONFIG_PERF_MEMORY_BOUND_MPKI * instructions ? "memory" : "compute";
+}
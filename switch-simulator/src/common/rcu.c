@@ -0,0 +1,246 @@
+/**
+ * @file rcu.c
+ * @brief Epoch-based read-copy-update implementation
+ *
+ * Each thread that reads RCU-protected data owns a reader record on a
+ * global list. On entering its outermost read section the thread stores
+ * the current global epoch in its record, and clears it on leaving. An
+ * object retired while the global epoch is E can only have been loaded
+ * by readers that entered in an epoch <= E, so it is freed once the
+ * oldest active reader entered after E. Reader records are never freed;
+ * there is at most one per thread that ever read.
+ *
+ * A QSBR worker keeps the epoch of its last quiescent state in its record
+ * while online, whatever its read sections do, so the same minimum over
+ * the records covers both kinds of reader.
+ */
+
+#include <stdlib.h>
+#include <sched.h>
+
+#include "../../include/common/rcu.h"
+#include "../../include/common/threading.h"
+
+/**
+ * @brief Reader record, one per thread that enters read sections
+ */
+typedef struct rcu_reader {
+    volatile uint64_t epoch;        /**< Epoch observed on entry, 0 when outside a read section */
+    uint32_t nesting;               /**< Read section nesting depth */
+    bool qsbr;                      /**< Registered QSBR worker */
+    bool online;                    /**< QSBR worker not offline */
+    struct rcu_reader *next;        /**< Global reader list link */
+} rcu_reader_t;
+
+/**
+ * @brief Global epoch, advanced every time an object is retired
+ */
+static volatile uint64_t g_rcu_epoch = 1;
+
+/**
+ * @brief List of all reader records
+ */
+static rcu_reader_t *volatile g_rcu_readers = NULL;
+
+/**
+ * @brief Objects retired but possibly still used by readers
+ */
+static rcu_head_t *g_rcu_retired = NULL;
+static spinlock_t g_rcu_retired_lock = { 0 };
+
+/**
+ * @brief Reader record of the calling thread
+ */
+static _Thread_local rcu_reader_t *t_rcu_reader = NULL;
+
+/**
+ * @brief Reader record of the calling thread, registered on first use
+ *
+ * @return Record, or NULL if it could not be allocated
+ */
+static rcu_reader_t *rcu_this_reader(void) {
+    rcu_reader_t *reader = t_rcu_reader;
+
+    if (!reader) {
+        reader = (rcu_reader_t *)calloc(1, sizeof(rcu_reader_t));
+        if (!reader) {
+            return NULL;
+        }
+        rcu_reader_t *head;
+        do {
+            head = __atomic_load_n(&g_rcu_readers, __ATOMIC_ACQUIRE);
+            reader->next = head;
+        } while (!__sync_bool_compare_and_swap(&g_rcu_readers, head, reader));
+        t_rcu_reader = reader;
+    }
+
+    return reader;
+}
+
+/**
+ * @brief Publish the current global epoch in a reader record
+ */
+static inline void rcu_observe_epoch(rcu_reader_t *reader) {
+    __atomic_store_n(&reader->epoch, __atomic_load_n(&g_rcu_epoch, __ATOMIC_SEQ_CST),
+                     __ATOMIC_SEQ_CST);
+}
+
+status_t rcu_read_lock(void) {
+    rcu_reader_t *reader = rcu_this_reader();
+
+    if (!reader) {
+        return STATUS_NO_MEMORY;
+    }
+
+    // An online worker's record already holds back reclamation
+    if (reader->nesting++ == 0 && !reader->online) {
+        rcu_observe_epoch(reader);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+void rcu_read_unlock(void) {
+    rcu_reader_t *reader = t_rcu_reader;
+
+    if (reader && --reader->nesting == 0 && !reader->online) {
+        __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+    }
+}
+
+status_t rcu_register_worker(void) {
+    rcu_reader_t *reader = rcu_this_reader();
+
+    if (!reader) {
+        return STATUS_NO_MEMORY;
+    }
+    if (reader->qsbr) {
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    reader->qsbr = true;
+    reader->online = true;
+    rcu_observe_epoch(reader);
+    return STATUS_SUCCESS;
+}
+
+void rcu_unregister_worker(void) {
+    rcu_reader_t *reader = t_rcu_reader;
+
+    if (!reader || !reader->qsbr) {
+        return;
+    }
+
+    reader->qsbr = false;
+    reader->online = false;
+    if (reader->nesting == 0) {
+        __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+    }
+}
+
+void rcu_quiescent_state(void) {
+    rcu_reader_t *reader = t_rcu_reader;
+
+    if (reader && reader->online && reader->nesting == 0) {
+        rcu_observe_epoch(reader);
+    }
+}
+
+void rcu_worker_offline(void) {
+    rcu_reader_t *reader = t_rcu_reader;
+
+    if (reader && reader->online) {
+        reader->online = false;
+        if (reader->nesting == 0) {
+            __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+void rcu_worker_online(void) {
+    rcu_reader_t *reader = t_rcu_reader;
+
+    if (reader && reader->qsbr && !reader->online) {
+        reader->online = true;
+        if (reader->nesting == 0) {
+            rcu_observe_epoch(reader);
+        }
+    }
+}
+
+/**
+ * @brief Oldest epoch among active readers
+ *
+ * @return Minimum reader epoch, or UINT64_MAX if no reader is active
+ */
+static uint64_t rcu_min_reader_epoch(void) {
+    uint64_t min_epoch = UINT64_MAX;
+
+    for (rcu_reader_t *r = __atomic_load_n(&g_rcu_readers, __ATOMIC_ACQUIRE); r; r = r->next) {
+        uint64_t e = __atomic_load_n(&r->epoch, __ATOMIC_SEQ_CST);
+        if (e != 0 && e < min_epoch) {
+            min_epoch = e;
+        }
+    }
+
+    return min_epoch;
+}
+
+/**
+ * @brief Free retired objects that no reader can still see
+ */
+static void rcu_reclaim(void) {
+    rcu_head_t *done = NULL;
+
+    spinlock_acquire(&g_rcu_retired_lock);
+    uint64_t min_epoch = rcu_min_reader_epoch();
+    rcu_head_t **link = &g_rcu_retired;
+    while (*link) {
+        rcu_head_t *head = *link;
+        if (head->retire_epoch < min_epoch) {
+            *link = head->next;
+            head->next = done;
+            done = head;
+        } else {
+            link = &head->next;
+        }
+    }
+    spinlock_release(&g_rcu_retired_lock);
+
+    // Destructors run outside the lock so they may retire objects themselves
+    while (done) {
+        rcu_head_t *next = done->next;
+        done->free_fn(done);
+        done = next;
+    }
+}
+
+void rcu_retire(rcu_head_t *head, rcu_free_fn_t free_fn) {
+    if (!head || !free_fn) {
+        return;
+    }
+
+    head->free_fn = free_fn;
+    head->retire_epoch = __atomic_fetch_add(&g_rcu_epoch, 1, __ATOMIC_SEQ_CST);
+
+    spinlock_acquire(&g_rcu_retired_lock);
+    head->next = g_rcu_retired;
+    g_rcu_retired = head;
+    spinlock_release(&g_rcu_retired_lock);
+
+    rcu_reclaim();
+}
+
+void rcu_synchronize(void) {
+    uint64_t target = __atomic_fetch_add(&g_rcu_epoch, 1, __ATOMIC_SEQ_CST);
+
+    // A worker waiting on itself would never see its own record move
+    rcu_quiescent_state();
+
+    // Wait until every reader that may have entered before the bump has left
+    while (rcu_min_reader_epoch() <= target) {
+        sched_yield();
+    }
+
+    rcu_reclaim();
+}
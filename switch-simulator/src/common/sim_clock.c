@@ -0,0 +1,138 @@
+/**
+ * @file sim_clock.c
+ * @brief Simulator clock implementation
+ *
+ * The virtual clock is one atomic microsecond count. Entering virtual
+ * mode starts it at the current monotonic time and remembers the wall
+ * time that goes with it, so both clocks carry on from where they were.
+ */
+
+#include <time.h>
+
+#include "../../include/common/sim_clock.h"
+#include "../../include/common/config.h"
+#include "../../include/common/logging.h"
+
+/**
+ * @brief Clock state
+ */
+static struct {
+    sim_clock_mode_t mode;
+    uint64_t virtual_us;        /**< Virtual monotonic time */
+    uint64_t virtual_base_us;   /**< Virtual time when virtual mode was entered */
+    uint64_t wall_base_us;      /**< Wall time when virtual mode was entered */
+} g_clock = { .mode = CONFIG_SIM_CLOCK_VIRTUAL ? SIM_CLOCK_VIRTUAL : SIM_CLOCK_REALTIME };
+
+/**
+ * @brief System monotonic time in microseconds
+ */
+static inline uint64_t sim_clock_real_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Select real or virtual time
+ *
+ * @param mode Clock mode
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER for a bad mode
+ */
+status_t sim_clock_set_mode(sim_clock_mode_t mode) {
+    struct timespec wall;
+
+    if (mode != SIM_CLOCK_REALTIME && mode != SIM_CLOCK_VIRTUAL) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (mode == SIM_CLOCK_VIRTUAL && sim_clock_get_mode() != SIM_CLOCK_VIRTUAL) {
+        clock_gettime(CLOCK_REALTIME, &wall);
+        g_clock.virtual_base_us = sim_clock_real_us();
+        g_clock.wall_base_us = (uint64_t)wall.tv_sec * 1000000 + (uint64_t)wall.tv_nsec / 1000;
+        __atomic_store_n(&g_clock.virtual_us, g_clock.virtual_base_us, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&g_clock.mode, mode, __ATOMIC_RELEASE);
+
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Simulator clock is %s",
+             mode == SIM_CLOCK_VIRTUAL ? "virtual" : "real time");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the clock mode
+ *
+ * @return Current mode
+ */
+sim_clock_mode_t sim_clock_get_mode(void) {
+    return __atomic_load_n(&g_clock.mode, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Check whether the clock is virtual
+ *
+ * @return true in virtual mode
+ */
+bool sim_clock_is_virtual(void) {
+    return sim_clock_get_mode() == SIM_CLOCK_VIRTUAL;
+}
+
+/**
+ * @brief Monotonic time in microseconds
+ *
+ * @return Current time
+ */
+uint64_t sim_clock_now_us(void) {
+    if (sim_clock_is_virtual()) {
+        return __atomic_load_n(&g_clock.virtual_us, __ATOMIC_ACQUIRE);
+    }
+    return sim_clock_real_us();
+}
+
+/**
+ * @brief Wall-clock time in seconds, the simulator's time(NULL)
+ *
+ * @return Seconds since the Unix epoch
+ */
+time_t sim_clock_time(void) {
+    if (sim_clock_is_virtual()) {
+        uint64_t elapsed = __atomic_load_n(&g_clock.virtual_us, __ATOMIC_ACQUIRE) - g_clock.virtual_base_us;
+        return (time_t)((g_clock.wall_base_us + elapsed) / 1000000);
+    }
+    return time(NULL);
+}
+
+/**
+ * @brief Move the virtual clock forward to a monotonic time
+ *
+ * @param target_us Monotonic time, as sim_clock_now_us() reports it
+ * @return STATUS_SUCCESS on success, STATUS_NOT_SUPPORTED in real-time mode
+ */
+status_t sim_clock_advance_to_us(uint64_t target_us) {
+    if (!sim_clock_is_virtual()) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    // Several threads may advance at once; the clock only ever goes forward
+    uint64_t now = __atomic_load_n(&g_clock.virtual_us, __ATOMIC_RELAXED);
+    while (now < target_us &&
+           !__atomic_compare_exchange_n(&g_clock.virtual_us, &now, target_us, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Move the virtual clock forward
+ *
+ * @param delta_us Microseconds to skip
+ * @return STATUS_SUCCESS on success, STATUS_NOT_SUPPORTED in real-time mode
+ */
+status_t sim_clock_advance_us(uint64_t delta_us) {
+    if (!sim_clock_is_virtual()) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    __atomic_fetch_add(&g_clock.virtual_us, delta_us, __ATOMIC_RELEASE);
+    return STATUS_SUCCESS;
+}
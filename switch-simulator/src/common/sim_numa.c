@@ -0,0 +1,258 @@
+/**
+ * @file sim_numa.c
+ * @brief NUMA topology and memory placement implementation
+ *
+ * Nodes are numbered densely here, in the order sysfs lists nodes that
+ * have CPUs; node_id[] maps them back to kernel node numbers for mbind.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "../../include/common/sim_numa.h"
+#include "../../include/common/config.h"
+#include "../../include/common/logging.h"
+
+/**
+ * @brief CPUs the node map covers
+ */
+#define SIM_NUMA_MAX_CPUS       1024
+
+/**
+ * @brief Kernel node numbers the node masks cover
+ */
+#define SIM_NUMA_MASK_BITS      64
+
+/* mbind(2) modes and flags, without <numaif.h> */
+#define SIM_MPOL_PREFERRED      1
+#define SIM_MPOL_MF_MOVE        (1 << 1)
+
+/**
+ * @brief Node layout, read once
+ */
+static struct {
+    pthread_once_t once;
+    uint32_t node_count;                        /**< Nodes with CPUs */
+    uint32_t node_id[CONFIG_NUMA_MAX_NODES];    /**< Kernel node number of each node */
+    uint8_t cpu_node[SIM_NUMA_MAX_CPUS];        /**< Node of each CPU */
+} g_numa = { .once = PTHREAD_ONCE_INIT, .node_count = 1 };
+
+/**
+ * @brief Node of the calling thread, -1 until looked up
+ */
+static __thread int32_t t_numa_node = -1;
+
+/**
+ * @brief Parse a CPU list such as "0-3,8,10-11"
+ *
+ * @param list CPU list
+ * @param[out] cpus CPUs in list order
+ * @param max Size of cpus
+ * @return Number of CPUs stored, 0 for an empty or malformed list
+ */
+uint32_t sim_numa_parse_cpu_list(const char *list, uint32_t *cpus, uint32_t max) {
+    uint32_t count = 0;
+    const char *p = list;
+
+    if (!list || !cpus) {
+        return 0;
+    }
+
+    while (*p && *p != '\n') {
+        char *end;
+        unsigned long first = strtoul(p, &end, 10);
+        unsigned long last = first;
+
+        if (end == p) {
+            return 0;
+        }
+        p = end;
+        if (*p == '-') {
+            last = strtoul(p + 1, &end, 10);
+            if (end == p + 1 || last < first) {
+                return 0;
+            }
+            p = end;
+        }
+        for (unsigned long cpu = first; cpu <= last && count < max; cpu++) {
+            cpus[count++] = (uint32_t)cpu;
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p && *p != '\n') {
+            return 0;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Read the node layout from sysfs
+ */
+static void sim_numa_discover(void) {
+    static uint32_t cpus[SIM_NUMA_MAX_CPUS];
+    uint32_t count = 0;
+
+    for (uint32_t id = 0; id < SIM_NUMA_MASK_BITS && count < CONFIG_NUMA_MAX_NODES; id++) {
+        char path[64];
+        char list[4096];
+        FILE *f;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", id);
+        f = fopen(path, "r");
+        if (!f) {
+            continue;
+        }
+        if (!fgets(list, sizeof(list), f)) {
+            list[0] = '\0';
+        }
+        fclose(f);
+
+        // Memory-only nodes run no workers
+        uint32_t n = sim_numa_parse_cpu_list(list, cpus, SIM_NUMA_MAX_CPUS);
+        if (n == 0) {
+            continue;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            if (cpus[i] < SIM_NUMA_MAX_CPUS) {
+                g_numa.cpu_node[cpus[i]] = (uint8_t)count;
+            }
+        }
+        g_numa.node_id[count++] = id;
+    }
+
+    if (count == 0) {
+        count = 1;
+        g_numa.node_id[0] = 0;
+    }
+    g_numa.node_count = count;
+
+    if (count > 1) {
+        LOG_INFO(LOG_CATEGORY_SYSTEM, "NUMA: %u nodes%s", count,
+                 CONFIG_NUMA_REPLICATE_TABLES ? ", read-mostly tables replicated" : "");
+    }
+}
+
+/**
+ * @brief Number of NUMA nodes, at most CONFIG_NUMA_MAX_NODES
+ *
+ * @return Node count, 1 if the host has no NUMA information
+ */
+uint32_t sim_numa_node_count(void) {
+    pthread_once(&g_numa.once, sim_numa_discover);
+    return g_numa.node_count;
+}
+
+/**
+ * @brief Node a CPU belongs to
+ *
+ * @param cpu CPU number
+ * @return Node, 0 for an unknown CPU
+ */
+uint32_t sim_numa_node_of_cpu(uint32_t cpu) {
+    pthread_once(&g_numa.once, sim_numa_discover);
+    return cpu < SIM_NUMA_MAX_CPUS ? g_numa.cpu_node[cpu] : 0;
+}
+
+/**
+ * @brief Node of the calling thread
+ *
+ * @return Node
+ */
+uint32_t sim_numa_current_node(void) {
+    if (t_numa_node < 0) {
+        int cpu = sched_getcpu();
+        t_numa_node = (int32_t)sim_numa_node_of_cpu(cpu < 0 ? 0 : (uint32_t)cpu);
+    }
+    return (uint32_t)t_numa_node;
+}
+
+/**
+ * @brief Check whether read-mostly tables keep a copy per node
+ *
+ * @return true with CONFIG_NUMA_REPLICATE_TABLES on a host of several nodes
+ */
+bool sim_numa_replicate_tables(void) {
+    return CONFIG_NUMA_REPLICATE_TABLES && sim_numa_node_count() > 1;
+}
+
+/**
+ * @brief Move memory to a node
+ *
+ * @param addr Start of the memory
+ * @param size Bytes
+ * @param node Node
+ * @return STATUS_SUCCESS on success or with one node, appropriate error code otherwise
+ */
+status_t sim_numa_bind_memory(void *addr, size_t size, uint32_t node) {
+    if (node >= sim_numa_node_count()) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (g_numa.node_count == 1 || !addr) {
+        return STATUS_SUCCESS;
+    }
+
+#ifdef SYS_mbind
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)addr + page - 1) & ~(page - 1);
+    uintptr_t end = ((uintptr_t)addr + size) & ~(page - 1);
+    unsigned long mask = 1UL << g_numa.node_id[node];
+
+    if (end <= start) {
+        return STATUS_SUCCESS;
+    }
+    if (syscall(SYS_mbind, (void *)start, end - start, SIM_MPOL_PREFERRED, &mask,
+                SIM_NUMA_MASK_BITS + 1, SIM_MPOL_MF_MOVE) != 0) {
+        LOG_DEBUG(LOG_CATEGORY_SYSTEM, "NUMA: Failed to place %zu bytes on node %u", size, node);
+        return STATUS_FAILURE;
+    }
+    return STATUS_SUCCESS;
+#else
+    (void)size;
+    return STATUS_SUCCESS;
+#endif
+}
+
+/**
+ * @brief Allocate zeroed memory on a node
+ *
+ * @param size Bytes
+ * @param node Node
+ * @return Memory, NULL on failure
+ */
+void *sim_numa_alloc(size_t size, uint32_t node) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    void *addr;
+
+    if (size == 0 || node >= sim_numa_node_count()) {
+        return NULL;
+    }
+
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        return NULL;
+    }
+
+    // Not touched yet, so the pages come from the node when first written
+    sim_numa_bind_memory(addr, (size + page - 1) & ~(page - 1), node);
+    return addr;
+}
+
+/**
+ * @brief Free memory of sim_numa_alloc()
+ *
+ * @param addr Memory, may be NULL
+ * @param size Bytes given to sim_numa_alloc()
+ */
+void sim_numa_free(void *addr, size_t size) {
+    if (addr) {
+        munmap(addr, size);
+    }
+}
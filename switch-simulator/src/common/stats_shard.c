@@ -0,0 +1,185 @@
+/**
+ * @file stats_shard.c
+ * @brief Per-thread sharded counters implementation
+ *
+ * Shards are allocated the first time a thread counts in a set and are
+ * only freed with the set. A thread finds its shards through a
+ * thread-local table indexed by set ID; the set generation stored with
+ * each entry tells a shard of a destroyed set from one of a newer set
+ * that got the same ID. Everything but counting runs under one mutex:
+ * it is only taken by threads joining or leaving a set and by readers.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../../include/common/stats_shard.h"
+#include "../../include/common/mem_account.h"
+
+/**
+ * @brief Shard header, followed by the counters on their own cache lines
+ */
+typedef struct stats_shard {
+    struct stats_shard *next;           /* All shards of the set */
+    struct stats_shard *next_free;      /* Free list of the set */
+    uint64_t words[] __attribute__((aligned(64)));
+} stats_shard_t;
+
+__thread stats_shard_slot_t g_stats_shard_slots[STATS_SHARD_MAX_SETS];
+
+static pthread_mutex_t g_shard_lock = PTHREAD_MUTEX_INITIALIZER;
+static stats_shard_set_t *g_shard_sets[STATS_SHARD_MAX_SETS];
+static uint32_t g_shard_generation;
+
+static pthread_once_t g_shard_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_shard_key;
+
+/**
+ * @brief Hand the shards of an exiting thread back to their sets
+ */
+static void stats_shard_thread_exit(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&g_shard_lock);
+    for (uint32_t id = 0; id < STATS_SHARD_MAX_SETS; id++) {
+        stats_shard_slot_t *slot = &g_stats_shard_slots[id];
+        stats_shard_set_t *set = g_shard_sets[id];
+
+        if (set && slot->generation == set->generation && slot->words != set->spill) {
+            stats_shard_t *shard = (stats_shard_t *)((char *)slot->words - offsetof(stats_shard_t, words));
+            shard->next_free = set->free_shards;
+            set->free_shards = shard;
+        }
+        slot->generation = 0;
+    }
+    pthread_mutex_unlock(&g_shard_lock);
+}
+
+static void stats_shard_key_init(void) {
+    pthread_key_create(&g_shard_key, stats_shard_thread_exit);
+}
+
+status_t stats_shard_create(size_t words, stats_shard_set_t **set) {
+    stats_shard_set_t *new_set;
+    uint32_t id;
+
+    if (words == 0 || !set) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    pthread_once(&g_shard_key_once, stats_shard_key_init);
+
+    new_set = (stats_shard_set_t *)mem_calloc(MEM_TAG_STATS, 1, sizeof(*new_set));
+    if (!new_set) {
+        return STATUS_NO_MEMORY;
+    }
+    new_set->words = words;
+    new_set->baseline = (uint64_t *)mem_calloc(MEM_TAG_STATS, words, sizeof(uint64_t));
+    new_set->spill = (uint64_t *)mem_calloc(MEM_TAG_STATS, words, sizeof(uint64_t));
+    if (!new_set->baseline || !new_set->spill) {
+        mem_free(MEM_TAG_STATS, new_set->baseline);
+        mem_free(MEM_TAG_STATS, new_set->spill);
+        mem_free(MEM_TAG_STATS, new_set);
+        return STATUS_NO_MEMORY;
+    }
+
+    pthread_mutex_lock(&g_shard_lock);
+    for (id = 0; id < STATS_SHARD_MAX_SETS && g_shard_sets[id]; id++) {
+    }
+    if (id == STATS_SHARD_MAX_SETS) {
+        pthread_mutex_unlock(&g_shard_lock);
+        mem_free(MEM_TAG_STATS, new_set->baseline);
+        mem_free(MEM_TAG_STATS, new_set->spill);
+        mem_free(MEM_TAG_STATS, new_set);
+        return STATUS_RESOURCE_EXHAUSTED;
+    }
+    // 0 marks an empty thread slot
+    if (++g_shard_generation == 0) {
+        ++g_shard_generation;
+    }
+    new_set->id = id;
+    new_set->generation = g_shard_generation;
+    g_shard_sets[id] = new_set;
+    pthread_mutex_unlock(&g_shard_lock);
+
+    *set = new_set;
+    return STATUS_SUCCESS;
+}
+
+void stats_shard_destroy(stats_shard_set_t *set) {
+    stats_shard_t *shard;
+
+    if (!set) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_shard_lock);
+    g_shard_sets[set->id] = NULL;
+    pthread_mutex_unlock(&g_shard_lock);
+
+    while ((shard = set->shards) != NULL) {
+        set->shards = shard->next;
+        mem_free(MEM_TAG_STATS, shard);
+    }
+    mem_free(MEM_TAG_STATS, set->baseline);
+    mem_free(MEM_TAG_STATS, set->spill);
+    mem_free(MEM_TAG_STATS, set);
+}
+
+uint64_t *stats_shard_attach(stats_shard_set_t *set) {
+    stats_shard_slot_t *slot = &g_stats_shard_slots[set->id];
+    stats_shard_t *shard;
+    uint64_t *words;
+
+    pthread_mutex_lock(&g_shard_lock);
+    shard = set->free_shards;
+    if (shard) {
+        set->free_shards = shard->next_free;
+    } else {
+        size_t size = (set->words * sizeof(uint64_t) + 63) & ~(size_t)63;
+        if ((shard = mem_aligned_alloc(MEM_TAG_STATS, 64, sizeof(stats_shard_t) + size)) != NULL) {
+            memset(shard, 0, sizeof(stats_shard_t) + size);
+            shard->next = set->shards;
+            set->shards = shard;
+        } else {
+            shard = NULL;
+        }
+    }
+    words = shard ? shard->words : set->spill;
+    slot->words = words;
+    slot->generation = set->generation;
+    pthread_mutex_unlock(&g_shard_lock);
+
+    // Any value other than NULL runs the destructor at thread exit
+    pthread_setspecific(g_shard_key, set);
+    return words;
+}
+
+/**
+ * @brief Sum one counter over all shards; called with the lock held
+ */
+static uint64_t stats_shard_sum(const stats_shard_set_t *set, size_t index) {
+    uint64_t sum = __atomic_load_n(&set->spill[index], __ATOMIC_RELAXED);
+
+    for (const stats_shard_t *shard = set->shards; shard; shard = shard->next) {
+        sum += __atomic_load_n(&shard->words[index], __ATOMIC_RELAXED);
+    }
+    return sum;
+}
+
+void stats_shard_fold(stats_shard_set_t *set, size_t first, size_t count, uint64_t *out) {
+    pthread_mutex_lock(&g_shard_lock);
+    for (size_t i = 0; i < count && first + i < set->words; i++) {
+        out[i] = stats_shard_sum(set, first + i) - set->baseline[first + i];
+    }
+    pthread_mutex_unlock(&g_shard_lock);
+}
+
+void stats_shard_clear(stats_shard_set_t *set, size_t first, size_t count) {
+    pthread_mutex_lock(&g_shard_lock);
+    for (size_t i = 0; i < count && first + i < set->words; i++) {
+        set->baseline[first + i] = stats_shard_sum(set, first + i);
+    }
+    pthread_mutex_unlock(&g_shard_lock);
+}
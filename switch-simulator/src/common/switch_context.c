@@ -0,0 +1,23 @@
+/**
+ * @file switch_context.c
+ * @brief Switch instance binding of threads
+ */
+
+#include "../../include/common/switch_context.h"
+
+__thread uint32_t t_switch_instance = SWITCH_INSTANCE_DEFAULT;
+
+/**
+ * @brief Bind the calling thread to an instance
+ *
+ * @param instance Instance number
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER if out of range
+ */
+status_t switch_context_bind(uint32_t instance) {
+    if (instance >= CONFIG_MAX_SWITCH_INSTANCES) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    t_switch_instance = instance;
+    return STATUS_SUCCESS;
+}
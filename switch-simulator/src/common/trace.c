@@ -0,0 +1,369 @@
+/**
+ * @file trace.c
+ * @brief Binary tracing of high-rate control plane events
+ *
+ * Each thread records into its own ring, written only by that thread. A
+ * record is stored as four words: the writer first bumps the ring's
+ * reserved count, then stores the words, then bumps its committed count.
+ * A reader copies the committed records and afterwards reads the reserved
+ * count, which tells it which of the copied slots may have been written
+ * over meanwhile, so a dump never needs to stop the writers.
+ */
+
+#include "../../include/common/trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "../../include/common/logging.h"
+
+#define TRACE_MAX_RINGS         64      /* Threads with a ring; others record nothing */
+#define TRACE_RING_MASK         ((uint64_t)CONFIG_TRACE_RING_SIZE - 1)
+#define TRACE_RECORD_WORDS      (sizeof(trace_record_t) / sizeof(uint64_t))
+
+_Static_assert((CONFIG_TRACE_RING_SIZE & (CONFIG_TRACE_RING_SIZE - 1)) == 0,
+               "CONFIG_TRACE_RING_SIZE must be a power of two");
+_Static_assert(sizeof(trace_record_t) == 32, "trace_record_t must be four words");
+_Static_assert(TRACE_EVENT_COUNT <= 64, "events must fit the event mask");
+
+/**
+ * @brief Record ring of one thread
+ */
+typedef struct {
+    uint64_t reserved __attribute__((aligned(64)));  /* Records begun, by the owner */
+    uint64_t committed;                               /* Records complete, by the owner */
+    uint64_t cleared __attribute__((aligned(64)));   /* Records before this were cleared */
+    bool in_use;                                      /* Owned by a live thread */
+    uint16_t id;
+    trace_record_t *records;
+} trace_ring_t;
+
+uint64_t g_trace_events = 0;
+
+static struct {
+    pthread_mutex_t lock;       /* Serializes ring creation, clears and dumps */
+    trace_ring_t *rings[TRACE_MAX_RINGS];
+    uint32_t ring_count;
+    uint64_t start_tsc;
+    uint64_t start_ns;          /* CLOCK_REALTIME */
+    uint64_t start_mono_ns;     /* CLOCK_MONOTONIC, for calibration */
+} g_trace = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static __thread trace_ring_t *t_trace_ring;
+
+static pthread_once_t g_ring_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_ring_key;
+
+static const char *const g_event_names[TRACE_EVENT_COUNT] = {
+    [TRACE_MAC_LEARN]    = "mac-learn",
+    [TRACE_MAC_MOVE]     = "mac-move",
+    [TRACE_MAC_REMOVE]   = "mac-remove",
+    [TRACE_ROUTE_ADD]    = "route-add",
+    [TRACE_ROUTE_REMOVE] = "route-remove",
+    [TRACE_ARP_STATE]    = "arp-state",
+    [TRACE_STP_ROLE]     = "stp-role",
+    [TRACE_STP_STATE]    = "stp-state",
+};
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+status_t trace_init(void) {
+    pthread_mutex_lock(&g_trace.lock);
+    if (g_trace.start_tsc == 0) {
+        g_trace.start_ns = clock_ns(CLOCK_REALTIME);
+        g_trace.start_mono_ns = clock_ns(CLOCK_MONOTONIC);
+        g_trace.start_tsc = trace_now();
+    }
+    pthread_mutex_unlock(&g_trace.lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Release the ring of an exiting thread for the next one
+ */
+static void trace_ring_thread_exit(void *arg) {
+    trace_ring_t *ring = (trace_ring_t *)arg;
+
+    __atomic_store_n(&ring->in_use, false, __ATOMIC_RELEASE);
+}
+
+static void trace_ring_key_init(void) {
+    pthread_key_create(&g_ring_key, trace_ring_thread_exit);
+}
+
+/**
+ * @brief Ring of the calling thread, claimed or created on first use
+ *
+ * Rings live as long as the process: a released ring is taken over, with
+ * its records, by the next thread without one.
+ *
+ * @return Ring, or NULL if TRACE_MAX_RINGS are in use or memory is short
+ */
+static trace_ring_t *trace_ring_local(void) {
+    trace_ring_t *ring = NULL;
+    uint32_t count;
+
+    pthread_once(&g_ring_key_once, trace_ring_key_init);
+
+    count = __atomic_load_n(&g_trace.ring_count, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < count && !ring; i++) {
+        bool expected = false;
+
+        if (__atomic_compare_exchange_n(&g_trace.rings[i]->in_use, &expected, true, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            ring = g_trace.rings[i];
+        }
+    }
+
+    if (!ring) {
+        pthread_mutex_lock(&g_trace.lock);
+        if (g_trace.ring_count < TRACE_MAX_RINGS) {
+            ring = (trace_ring_t *)aligned_alloc(64, sizeof(trace_ring_t));
+            if (ring) {
+                memset(ring, 0, sizeof(*ring));
+                ring->records = (trace_record_t *)aligned_alloc(64, sizeof(trace_record_t) * CONFIG_TRACE_RING_SIZE);
+                if (!ring->records) {
+                    free(ring);
+                    ring = NULL;
+                }
+            }
+            if (ring) {
+                ring->id = (uint16_t)g_trace.ring_count;
+                ring->in_use = true;
+                g_trace.rings[g_trace.ring_count] = ring;
+                __atomic_store_n(&g_trace.ring_count, g_trace.ring_count + 1, __ATOMIC_RELEASE);
+            }
+        }
+        pthread_mutex_unlock(&g_trace.lock);
+        if (!ring) {
+            return NULL;
+        }
+    }
+
+    pthread_setspecific(g_ring_key, ring);
+    t_trace_ring = ring;
+    return ring;
+}
+
+void trace_record(trace_event_t event, uint32_t a0, uint64_t a1, uint64_t a2) {
+    trace_ring_t *ring = t_trace_ring;
+    trace_record_t record;
+    uint64_t words[TRACE_RECORD_WORDS];
+    uint64_t *slot;
+    uint64_t n;
+
+    if (!ring) {
+        ring = trace_ring_local();
+        if (!ring) {
+            return;
+        }
+    }
+
+    record.tsc = trace_now();
+    record.event = (uint16_t)event;
+    record.ring = ring->id;
+    record.a0 = a0;
+    record.a1 = a1;
+    record.a2 = a2;
+    memcpy(words, &record, sizeof(words));
+
+    n = __atomic_load_n(&ring->committed, __ATOMIC_RELAXED);
+    slot = (uint64_t *)&ring->records[n & TRACE_RING_MASK];
+
+    // Readers that see any of the new words also see the slot reserved
+    __atomic_store_n(&ring->reserved, n + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (size_t i = 0; i < TRACE_RECORD_WORDS; i++) {
+        __atomic_store_n(&slot[i], words[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&ring->committed, n + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Copy the intact records of a ring, oldest first; caller holds g_trace.lock
+ *
+ * @param ring Ring
+ * @param[out] out Room for CONFIG_TRACE_RING_SIZE records
+ * @return Records copied
+ */
+static uint32_t trace_ring_copy(trace_ring_t *ring, trace_record_t *out) {
+    uint64_t committed = __atomic_load_n(&ring->committed, __ATOMIC_ACQUIRE);
+    uint64_t first = committed > CONFIG_TRACE_RING_SIZE ? committed - CONFIG_TRACE_RING_SIZE : 0;
+    uint64_t reserved;
+    uint64_t intact;
+
+    if (first < ring->cleared) {
+        first = ring->cleared;
+    }
+    for (uint64_t i = first; i < committed; i++) {
+        const uint64_t *slot = (const uint64_t *)&ring->records[i & TRACE_RING_MASK];
+        uint64_t words[TRACE_RECORD_WORDS];
+
+        for (size_t w = 0; w < TRACE_RECORD_WORDS; w++) {
+            words[w] = __atomic_load_n(&slot[w], __ATOMIC_RELAXED);
+        }
+        memcpy(&out[i - first], words, sizeof(words));
+    }
+
+    // Slots below reserved - size may have been written over while copied
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    reserved = __atomic_load_n(&ring->reserved, __ATOMIC_RELAXED);
+    intact = reserved > CONFIG_TRACE_RING_SIZE ? reserved - CONFIG_TRACE_RING_SIZE : 0;
+    if (intact > committed) {
+        return 0;
+    }
+    if (intact > first) {
+        memmove(out, &out[intact - first], (size_t)(committed - intact) * sizeof(*out));
+        first = intact;
+    }
+    return (uint32_t)(committed - first);
+}
+
+void trace_enable(uint64_t events) {
+    __atomic_fetch_or(&g_trace_events, events & TRACE_ALL_EVENTS, __ATOMIC_RELAXED);
+}
+
+void trace_disable(uint64_t events) {
+    __atomic_fetch_and(&g_trace_events, ~events, __ATOMIC_RELAXED);
+}
+
+uint64_t trace_get_events(void) {
+    return __atomic_load_n(&g_trace_events, __ATOMIC_RELAXED);
+}
+
+const char *trace_event_name(trace_event_t event) {
+    if ((uint32_t)event >= TRACE_EVENT_COUNT) {
+        return "unknown";
+    }
+    return g_event_names[event];
+}
+
+status_t trace_event_from_name(const char *name, trace_event_t *event) {
+    if (!name || !event) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    for (uint32_t e = 0; e < TRACE_EVENT_COUNT; e++) {
+        if (strcmp(name, g_event_names[e]) == 0) {
+            *event = (trace_event_t)e;
+            return STATUS_SUCCESS;
+        }
+    }
+    return STATUS_NOT_FOUND;
+}
+
+void trace_get_counts(uint64_t *recorded, uint64_t *lost) {
+    uint64_t kept = 0;
+    uint64_t over = 0;
+
+    pthread_mutex_lock(&g_trace.lock);
+    for (uint32_t i = 0; i < g_trace.ring_count; i++) {
+        trace_ring_t *ring = g_trace.rings[i];
+        uint64_t total = __atomic_load_n(&ring->committed, __ATOMIC_RELAXED) - ring->cleared;
+
+        if (total > CONFIG_TRACE_RING_SIZE) {
+            over += total - CONFIG_TRACE_RING_SIZE;
+            total = CONFIG_TRACE_RING_SIZE;
+        }
+        kept += total;
+    }
+    pthread_mutex_unlock(&g_trace.lock);
+
+    if (recorded) {
+        *recorded = kept;
+    }
+    if (lost) {
+        *lost = over;
+    }
+}
+
+void trace_clear(void) {
+    pthread_mutex_lock(&g_trace.lock);
+    for (uint32_t i = 0; i < g_trace.ring_count; i++) {
+        g_trace.rings[i]->cleared = __atomic_load_n(&g_trace.rings[i]->committed, __ATOMIC_ACQUIRE);
+    }
+    pthread_mutex_unlock(&g_trace.lock);
+}
+
+status_t trace_dump(const char *path, uint64_t *written) {
+    trace_file_header_t header;
+    char names[TRACE_EVENT_COUNT][TRACE_NAME_MAX];
+    trace_record_t *buf;
+    uint64_t now_tsc;
+    uint64_t now_ns;
+    FILE *file;
+    status_t status = STATUS_SUCCESS;
+
+    if (!path) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    trace_init();
+
+    buf = (trace_record_t *)malloc(sizeof(trace_record_t) * CONFIG_TRACE_RING_SIZE);
+    if (!buf) {
+        return STATUS_NO_MEMORY;
+    }
+    file = fopen(path, "wb");
+    if (!file) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Cannot create trace file %s", path);
+        free(buf);
+        return STATUS_FAILURE;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic));
+    header.record_size = sizeof(trace_record_t);
+    header.event_count = TRACE_EVENT_COUNT;
+    memset(names, 0, sizeof(names));
+    for (uint32_t e = 0; e < TRACE_EVENT_COUNT; e++) {
+        snprintf(names[e], TRACE_NAME_MAX, "%s", g_event_names[e]);
+    }
+
+    pthread_mutex_lock(&g_trace.lock);
+    header.start_tsc = g_trace.start_tsc;
+    header.start_ns = g_trace.start_ns;
+    now_ns = clock_ns(CLOCK_MONOTONIC);
+    now_tsc = trace_now();
+    header.ticks_per_ns = now_ns > g_trace.start_mono_ns ?
+                          (double)(now_tsc - g_trace.start_tsc) / (double)(now_ns - g_trace.start_mono_ns) : 1.0;
+
+    // The record count is filled in once the rings are written
+    if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+        fwrite(names, sizeof(names), 1, file) != 1) {
+        status = STATUS_FAILURE;
+    }
+    for (uint32_t i = 0; i < g_trace.ring_count && status == STATUS_SUCCESS; i++) {
+        uint32_t n = trace_ring_copy(g_trace.rings[i], buf);
+
+        if (n > 0 && fwrite(buf, sizeof(trace_record_t), n, file) != n) {
+            status = STATUS_FAILURE;
+        }
+        header.record_count += n;
+    }
+    pthread_mutex_unlock(&g_trace.lock);
+
+    if (status == STATUS_SUCCESS &&
+        (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1)) {
+        status = STATUS_FAILURE;
+    }
+    if (fclose(file) != 0) {
+        status = STATUS_FAILURE;
+    }
+    free(buf);
+
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to write trace file %s", path);
+        return status;
+    }
+    if (written) {
+        *written = header.record_count;
+    }
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Wrote %llu trace records to %s",
+             (unsigned long long)header.record_count, path);
+    return STATUS_SUCCESS;
+}
@@ -9,6 +9,100 @@
 #include "../include/common/types.h"
 #include "../include/common/error_codes.h"
 #include "../include/common/logging.h"
+#include "../include/common/sim_clock.h"
+#include "../include/common/utils.h"
+
+/*
+ * Address text is produced and parsed with lookup tables rather than
+ * printf and scanf: no format string to interpret, no locale, and each
+ * character costs a load or two. Table dumps format thousands of
+ * addresses per call through the bulk variants.
+ */
+
+/** Lowercase hex digit of each nibble */
+static const char g_hex_digits[16] = {
+    '0', '1', '2', '3', '4', '5', '6', '7',
+    '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+};
+
+/** Value of each hex digit plus one; 0 for any other character */
+#define HEX_VALUE(c, v) [(unsigned char)(c)] = (v) + 1
+static const uint8_t g_hex_values[256] = {
+    HEX_VALUE('0', 0),  HEX_VALUE('1', 1),  HEX_VALUE('2', 2),  HEX_VALUE('3', 3),
+    HEX_VALUE('4', 4),  HEX_VALUE('5', 5),  HEX_VALUE('6', 6),  HEX_VALUE('7', 7),
+    HEX_VALUE('8', 8),  HEX_VALUE('9', 9),
+    HEX_VALUE('a', 10), HEX_VALUE('b', 11), HEX_VALUE('c', 12),
+    HEX_VALUE('d', 13), HEX_VALUE('e', 14), HEX_VALUE('f', 15),
+    HEX_VALUE('A', 10), HEX_VALUE('B', 11), HEX_VALUE('C', 12),
+    HEX_VALUE('D', 13), HEX_VALUE('E', 14), HEX_VALUE('F', 15),
+};
+#undef HEX_VALUE
+
+/**
+ * Decimal text of each byte value: the digits left-aligned in the first
+ * three characters, the number of digits in the fourth.
+ */
+#define DEC_OCTET(n) {                                                       \
+    (char)('0' + ((n) >= 100 ? (n) / 100 : (n) >= 10 ? (n) / 10 : (n))),     \
+    (char)('0' + ((n) >= 100 ? (n) / 10 % 10 : (n) % 10)),                   \
+    (char)('0' + (n) % 10),                                                  \
+    (char)((n) >= 100 ? 3 : (n) >= 10 ? 2 : 1) }
+#define DEC_OCTET4(n)   DEC_OCTET(n), DEC_OCTET((n) + 1), DEC_OCTET((n) + 2), DEC_OCTET((n) + 3)
+#define DEC_OCTET16(n)  DEC_OCTET4(n), DEC_OCTET4((n) + 4), DEC_OCTET4((n) + 8), DEC_OCTET4((n) + 12)
+#define DEC_OCTET64(n)  DEC_OCTET16(n), DEC_OCTET16((n) + 16), DEC_OCTET16((n) + 32), DEC_OCTET16((n) + 48)
+static const char g_dec_octets[256][4] = {
+    DEC_OCTET64(0), DEC_OCTET64(64), DEC_OCTET64(128), DEC_OCTET64(192)
+};
+#undef DEC_OCTET64
+#undef DEC_OCTET16
+#undef DEC_OCTET4
+#undef DEC_OCTET
+
+static inline int hex_value(char c) {
+    return (int)g_hex_values[(unsigned char)c] - 1;
+}
+
+static inline char *format_hex_byte(uint8_t byte, char *out) {
+    out[0] = g_hex_digits[byte >> 4];
+    out[1] = g_hex_digits[byte & 0x0F];
+    return out + 2;
+}
+
+/* Writes MAC_STRING_SIZE - 1 characters, no terminator */
+static inline char *format_mac(const mac_addr_t *mac, char *out) {
+    for (int i = 0; i < 6; i++) {
+        out = format_hex_byte(mac->addr[i], out);
+        *out++ = ':';
+    }
+    return out - 1;
+}
+
+/*
+ * Writes at most IPV4_STRING_SIZE - 1 characters, no terminator. Every
+ * octet stores three characters and keeps as many as it has digits, so
+ * the last one may touch the two characters after the text.
+ */
+static inline char *format_ipv4(ipv4_addr_t ipv4, char *out) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        const char *octet = g_dec_octets[(ipv4 >> shift) & 0xFF];
+        out[0] = octet[0];
+        out[1] = octet[1];
+        out[2] = octet[2];
+        out += octet[3];
+        *out++ = '.';
+    }
+    return out - 1;
+}
+
+/* Writes IPV6_STRING_SIZE - 1 characters, no terminator */
+static inline char *format_ipv6(const ipv6_addr_t *ipv6, char *out) {
+    for (int i = 0; i < 16; i += 2) {
+        out = format_hex_byte(ipv6->addr[i], out);
+        out = format_hex_byte(ipv6->addr[i + 1], out);
+        *out++ = ':';
+    }
+    return out - 1;
+}
 
 /**
  * @brief Convert MAC address to string representation
@@ -22,10 +116,7 @@ char* mac_to_string(const mac_addr_t *mac, char *buffer) {
         return NULL;
     }
     
-    snprintf(buffer, 18, "%02x:%02x:%02x:%02x:%02x:%02x",
-             mac->addr[0], mac->addr[1], mac->addr[2],
-             mac->addr[3], mac->addr[4], mac->addr[5]);
-    
+    *format_mac(mac, buffer) = '\0';
     return buffer;
 }
 
@@ -41,29 +132,34 @@ status_t string_to_mac(const char *str, mac_addr_t *mac) {
         return STATUS_INVALID_PARAMETER;
     }
     
-    unsigned int values[6];
-    int result = sscanf(str, "%02x:%02x:%02x:%02x:%02x:%02x",
-                       &values[0], &values[1], &values[2],
-                       &values[3], &values[4], &values[5]);
-    
-    if (result != 6) {
-        return STATUS_INVALID_PARAMETER;
-    }
-    
+    mac_addr_t parsed;
     for (int i = 0; i < 6; i++) {
-        if (values[i] > 255) {
+        int hi = hex_value(str[0]);
+        if (hi < 0) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        int lo = hex_value(str[1]);
+        if (lo < 0) {
+            parsed.addr[i] = (uint8_t)hi;
+            str += 1;
+        } else {
+            parsed.addr[i] = (uint8_t)(hi << 4 | lo);
+            str += 2;
+        }
+        if (*str != (i < 5 ? ':' : '\0')) {
             return STATUS_INVALID_PARAMETER;
         }
-        mac->addr[i] = (uint8_t)values[i];
+        str++;
     }
     
+    *mac = parsed;
     return STATUS_SUCCESS;
 }
 
 /**
  * @brief Convert IPv4 address to string representation
  * 
- * @param ipv4 IPv4 address in network byte order
+ * @param ipv4 IPv4 address, first octet in the most significant byte
  * @param buffer Output buffer (should be at least 16 bytes)
  * @return char* Pointer to buffer containing IP string
  */
@@ -72,14 +168,7 @@ char* ipv4_to_string(ipv4_addr_t ipv4, char *buffer) {
         return NULL;
     }
     
-    unsigned char bytes[4];
-    bytes[0] = ipv4 & 0xFF;
-    bytes[1] = (ipv4 >> 8) & 0xFF;
-    bytes[2] = (ipv4 >> 16) & 0xFF;
-    bytes[3] = (ipv4 >> 24) & 0xFF;
-    
-    snprintf(buffer, 16, "%d.%d.%d.%d", bytes[3], bytes[2], bytes[1], bytes[0]);
-    
+    *format_ipv4(ipv4, buffer) = '\0';
     return buffer;
 }
 
@@ -95,21 +184,26 @@ status_t string_to_ipv4(const char *str, ipv4_addr_t *ipv4) {
         return STATUS_INVALID_PARAMETER;
     }
     
-    unsigned int b[4];
-    int result = sscanf(str, "%u.%u.%u.%u", &b[0], &b[1], &b[2], &b[3]);
-    
-    if (result != 4) {
-        return STATUS_INVALID_PARAMETER;
-    }
-    
+    uint32_t addr = 0;
     for (int i = 0; i < 4; i++) {
-        if (b[i] > 255) {
+        uint32_t octet = 0;
+        int digits = 0;
+        while (digits < 3 && (uint8_t)(str[digits] - '0') < 10) {
+            octet = octet * 10 + (uint32_t)(str[digits] - '0');
+            digits++;
+        }
+        if (digits == 0 || octet > 255) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        str += digits;
+        if (*str != (i < 3 ? '.' : '\0')) {
             return STATUS_INVALID_PARAMETER;
         }
+        str++;
+        addr = addr << 8 | octet;
     }
     
-    *ipv4 = (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
-    
+    *ipv4 = addr;
     return STATUS_SUCCESS;
 }
 
@@ -125,15 +219,43 @@ char* ipv6_to_string(const ipv6_addr_t *ipv6, char *buffer) {
         return NULL;
     }
     
-    snprintf(buffer, 40, "%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x",
-             ipv6->addr[0], ipv6->addr[1], ipv6->addr[2], ipv6->addr[3],
-             ipv6->addr[4], ipv6->addr[5], ipv6->addr[6], ipv6->addr[7],
-             ipv6->addr[8], ipv6->addr[9], ipv6->addr[10], ipv6->addr[11],
-             ipv6->addr[12], ipv6->addr[13], ipv6->addr[14], ipv6->addr[15]);
-    
+    *format_ipv6(ipv6, buffer) = '\0';
     return buffer;
 }
 
+/*
+ * Parses up to max colon-separated groups of 1 to 4 hex digits. Stops
+ * at the end of the string or at "::", and sets *end to what follows.
+ * Returns the number of groups, or -1 if the text is malformed.
+ */
+static int parse_ipv6_groups(const char *str, uint16_t *groups, int max, const char **end) {
+    int count = 0;
+    
+    while (*str != '\0' && !(str[0] == ':' && str[1] == ':')) {
+        if (count > 0) {
+            if (*str != ':') {
+                return -1;
+            }
+            str++;
+        }
+        uint32_t group = 0;
+        int digits = 0;
+        int value;
+        while (digits < 4 && (value = hex_value(str[digits])) >= 0) {
+            group = group << 4 | (uint32_t)value;
+            digits++;
+        }
+        if (digits == 0 || count == max) {
+            return -1;
+        }
+        groups[count++] = (uint16_t)group;
+        str += digits;
+    }
+    
+    *end = str;
+    return count;
+}
+
 /**
  * @brief Convert string representation to IPv6 address
  * 
@@ -146,29 +268,133 @@ status_t string_to_ipv6(const char *str, ipv6_addr_t *ipv6) {
         return STATUS_INVALID_PARAMETER;
     }
     
-    // Simple implementation for basic format without compression
-    unsigned int values[16];
-    int fields = sscanf(str, 
-                      "%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x",
-                      &values[0], &values[1], &values[2], &values[3],
-                      &values[4], &values[5], &values[6], &values[7],
-                      &values[8], &values[9], &values[10], &values[11],
-                      &values[12], &values[13], &values[14], &values[15]);
-    
-    if (fields != 16) {
+    // Eight groups, or fewer around one "::" standing for the zero groups
+    uint16_t head[8], tail[8];
+    const char *rest;
+    int head_count = parse_ipv6_groups(str, head, 8, &rest);
+    int tail_count = 0;
+    if (head_count < 0) {
         return STATUS_INVALID_PARAMETER;
     }
-    
-    for (int i = 0; i < 16; i++) {
-        if (values[i] > 255) {
+    if (*rest != '\0') {
+        if (head_count == 8) {
             return STATUS_INVALID_PARAMETER;
         }
-        ipv6->addr[i] = (uint8_t)values[i];
+        tail_count = parse_ipv6_groups(rest + 2, tail, 7 - head_count, &rest);
+        if (tail_count < 0 || *rest != '\0') {
+            return STATUS_INVALID_PARAMETER;
+        }
+    } else if (head_count != 8) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    
+    memset(ipv6->addr, 0, sizeof(ipv6->addr));
+    for (int i = 0; i < head_count; i++) {
+        ipv6->addr[2 * i] = (uint8_t)(head[i] >> 8);
+        ipv6->addr[2 * i + 1] = (uint8_t)head[i];
+    }
+    for (int i = 0; i < tail_count; i++) {
+        int group = 8 - tail_count + i;
+        ipv6->addr[2 * group] = (uint8_t)(tail[i] >> 8);
+        ipv6->addr[2 * group + 1] = (uint8_t)tail[i];
     }
     
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Convert an array of MAC addresses to one string
+ *
+ * @param macs MAC addresses
+ * @param count Number of addresses
+ * @param separator Character written after each address
+ * @param buffer Output buffer
+ * @param size Size of buffer
+ * @param[out] length Characters written, without the terminator; may be NULL
+ * @return size_t Number of addresses converted
+ */
+size_t mac_to_string_bulk(const mac_addr_t *macs, size_t count, char separator,
+                          char *buffer, size_t size, size_t *length) {
+    size_t done = 0;
+    char *out = buffer;
+    
+    if (macs && buffer && size > 0) {
+        char *limit = buffer + size - 1;
+        while (done < count && limit - out >= MAC_STRING_SIZE) {
+            out = format_mac(&macs[done++], out);
+            *out++ = separator;
+        }
+        *out = '\0';
+    }
+    
+    if (length) {
+        *length = (size_t)(out - buffer);
+    }
+    return done;
+}
+
+/**
+ * @brief Convert an array of IPv4 addresses to one string
+ *
+ * @param addrs IPv4 addresses
+ * @param count Number of addresses
+ * @param separator Character written after each address
+ * @param buffer Output buffer
+ * @param size Size of buffer
+ * @param[out] length Characters written, without the terminator; may be NULL
+ * @return size_t Number of addresses converted
+ */
+size_t ipv4_to_string_bulk(const ipv4_addr_t *addrs, size_t count, char separator,
+                           char *buffer, size_t size, size_t *length) {
+    size_t done = 0;
+    char *out = buffer;
+    
+    if (addrs && buffer && size > 0) {
+        char *limit = buffer + size - 1;
+        while (done < count && limit - out >= IPV4_STRING_SIZE) {
+            out = format_ipv4(addrs[done++], out);
+            *out++ = separator;
+        }
+        *out = '\0';
+    }
+    
+    if (length) {
+        *length = (size_t)(out - buffer);
+    }
+    return done;
+}
+
+/**
+ * @brief Convert an array of IPv6 addresses to one string
+ *
+ * @param addrs IPv6 addresses
+ * @param count Number of addresses
+ * @param separator Character written after each address
+ * @param buffer Output buffer
+ * @param size Size of buffer
+ * @param[out] length Characters written, without the terminator; may be NULL
+ * @return size_t Number of addresses converted
+ */
+size_t ipv6_to_string_bulk(const ipv6_addr_t *addrs, size_t count, char separator,
+                           char *buffer, size_t size, size_t *length) {
+    size_t done = 0;
+    char *out = buffer;
+    
+    if (addrs && buffer && size > 0) {
+        char *limit = buffer + size - 1;
+        while (done < count && limit - out >= IPV6_STRING_SIZE) {
+            out = format_ipv6(&addrs[done++], out);
+            *out++ = separator;
+        }
+        *out = '\0';
+    }
+    
+    if (length) {
+        *length = (size_t)(out - buffer);
+    }
+    return done;
+}
+
 
 
 /**
@@ -263,6 +489,19 @@ const char* status_to_string(status_t status) {
     }
 }
 
+/**
+ * @brief Get string representation of an error code
+ *
+ * Callers pass plain status codes here as often as combined ones, so both
+ * are looked up as a status.
+ *
+ * @param error_code Error code
+ * @return String representation
+ */
+const char* error_to_string(uint32_t error_code) {
+    return status_to_string((status_t)(int32_t)error_code);
+}
+
 
 
 /**
@@ -321,9 +560,7 @@ bool mac_is_multicast(const mac_addr_t *mac) {
  * @return uint64_t Current timestamp
  */
 uint64_t get_timestamp_ms(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (uint64_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+    return sim_clock_now_us() / 1000;
 }
 
 /**
@@ -541,11 +778,12 @@ char* bytes_to_hex(const uint8_t *data, size_t length, char *buffer) {
         return NULL;
     }
     
+    char *out = buffer;
     for (size_t i = 0; i < length; i++) {
-        sprintf(buffer + (i * 2), "%02x", data[i]);
+        out = format_hex_byte(data[i], out);
     }
     
-    buffer[length * 2] = '\0';
+    *out = '\0';
     return buffer;
 }
 
@@ -574,11 +812,12 @@ status_t hex_to_bytes(const char *hex, uint8_t *data, size_t max_length, size_t
     }
     
     for (size_t i = 0; i < byte_count; i++) {
-        unsigned int value;
-        if (sscanf(hex + (i * 2), "%02x", &value) != 1) {
+        int hi = hex_value(hex[i * 2]);
+        int lo = hex_value(hex[i * 2 + 1]);
+        if (hi < 0 || lo < 0) {
             return STATUS_INVALID_PARAMETER;
         }
-        data[i] = (uint8_t)value;
+        data[i] = (uint8_t)(hi << 4 | lo);
     }
     
     *length = byte_count;
@@ -0,0 +1,234 @@
+/**
+ * @file cpu_trap.c
+ * @brief CPU port trap ring in shared memory
+ *
+ * Writers are serialized by one spinlock, which also keeps the ring
+ * mapped while a burst is being written, so closing never pulls the
+ * segment out from under the punt thread. head is published once per
+ * burst. The tail is owned by another process and is not trusted: a value
+ * that would claim more free records than the ring holds leaves the ring
+ * full until the consumer stores a sane one.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../../include/hal/cpu_trap.h"
+#include "../../include/common/config.h"
+#include "../../include/common/logging.h"
+#include "../../include/common/threading.h"
+
+#define CPU_TRAP_NAME_MAX 64
+
+/**
+ * @brief Writer side of the ring
+ */
+static struct {
+    spinlock_t lock;                    /* Writers, and open and close */
+    bool enabled;                       /* A ring is mapped */
+    char name[CPU_TRAP_NAME_MAX];
+    cpu_trap_header_t *hdr;             /* Mapped segment */
+    size_t size;                        /* Bytes mapped */
+} g_cpu_trap;
+
+/**
+ * @brief Round up to a cache line
+ */
+static size_t cpu_trap_align(size_t size) {
+    return (size + 63) & ~(size_t)63;
+}
+
+static uint64_t cpu_trap_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+status_t cpu_trap_open(const char *name, uint32_t slot_count, uint32_t snaplen) {
+    cpu_trap_header_t layout;
+    size_t slot_size;
+    size_t size;
+    void *map;
+    int fd;
+
+    if (!name) {
+        name = CPU_TRAP_DEFAULT_NAME;
+    }
+    if (slot_count == 0) {
+        slot_count = CONFIG_CPU_TRAP_RING_SIZE;
+    }
+    if (snaplen == 0) {
+        snaplen = CONFIG_CPU_TRAP_SNAPLEN;
+    }
+    if (name[0] != '/' || strlen(name) >= CPU_TRAP_NAME_MAX ||
+        (slot_count & (slot_count - 1)) != 0 || snaplen > UINT16_MAX) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (__atomic_load_n(&g_cpu_trap.enabled, __ATOMIC_ACQUIRE)) {
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    // Every record starts on its own cache line
+    slot_size = cpu_trap_align(sizeof(cpu_trap_record_t) + snaplen);
+    size = cpu_trap_align(sizeof(cpu_trap_header_t)) + (size_t)slot_count * slot_size;
+
+    memset(&layout, 0, sizeof(layout));
+    layout.magic = CPU_TRAP_MAGIC;
+    layout.version_major = CPU_TRAP_VERSION_MAJOR;
+    layout.version_minor = CPU_TRAP_VERSION_MINOR;
+    layout.header_size = sizeof(cpu_trap_header_t);
+    layout.writer_pid = (uint32_t)getpid();
+    layout.total_size = size;
+    layout.slot_count = slot_count;
+    layout.slot_size = (uint32_t)slot_size;
+    layout.snaplen = snaplen;
+    layout.slots_offset = (uint32_t)cpu_trap_align(sizeof(cpu_trap_header_t));
+
+    // A stale segment from an earlier run may have another layout
+    shm_unlink(name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "CPU trap: shm_open(%s) failed: %s", name, strerror(errno));
+        return STATUS_FAILURE;
+    }
+    if (ftruncate(fd, (off_t)size) != 0) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "CPU trap: failed to size %s: %s", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return STATUS_FAILURE;
+    }
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "CPU trap: failed to map %s: %s", name, strerror(errno));
+        shm_unlink(name);
+        return STATUS_FAILURE;
+    }
+    memcpy(map, &layout, sizeof(layout));
+
+    spinlock_acquire(&g_cpu_trap.lock);
+    if (g_cpu_trap.enabled) {
+        spinlock_release(&g_cpu_trap.lock);
+        munmap(map, size);
+        return STATUS_ALREADY_INITIALIZED;
+    }
+    strcpy(g_cpu_trap.name, name);
+    g_cpu_trap.hdr = (cpu_trap_header_t *)map;
+    g_cpu_trap.size = size;
+    __atomic_store_n(&g_cpu_trap.enabled, true, __ATOMIC_RELEASE);
+    spinlock_release(&g_cpu_trap.lock);
+
+    LOG_INFO(LOG_CATEGORY_HAL, "CPU trap: %u records of %u bytes in %s", slot_count, snaplen, name);
+    return STATUS_SUCCESS;
+}
+
+void cpu_trap_close(void) {
+    cpu_trap_header_t *hdr;
+    size_t size;
+
+    spinlock_acquire(&g_cpu_trap.lock);
+    if (!g_cpu_trap.enabled) {
+        spinlock_release(&g_cpu_trap.lock);
+        return;
+    }
+    __atomic_store_n(&g_cpu_trap.enabled, false, __ATOMIC_RELEASE);
+    hdr = g_cpu_trap.hdr;
+    size = g_cpu_trap.size;
+    g_cpu_trap.hdr = NULL;
+    spinlock_release(&g_cpu_trap.lock);
+
+    munmap(hdr, size);
+    shm_unlink(g_cpu_trap.name);
+    LOG_INFO(LOG_CATEGORY_HAL, "CPU trap: ring %s closed", g_cpu_trap.name);
+}
+
+bool cpu_trap_enabled(void) {
+    return __atomic_load_n(&g_cpu_trap.enabled, __ATOMIC_RELAXED);
+}
+
+uint32_t cpu_trap_submit(packet_buffer_t *const *pkts, uint32_t count, cpu_trap_reason_t reason) {
+    uint32_t written = 0;
+    uint64_t truncated = 0;
+
+    if (!pkts || count == 0 || (uint32_t)reason >= CPU_TRAP_REASON_COUNT) {
+        return 0;
+    }
+
+    spinlock_acquire(&g_cpu_trap.lock);
+    cpu_trap_header_t *hdr = g_cpu_trap.hdr;
+    if (!hdr) {
+        spinlock_release(&g_cpu_trap.lock);
+        return 0;
+    }
+
+    uint64_t head = hdr->head;
+    uint64_t used = head - __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+    uint32_t space = used <= hdr->slot_count ? hdr->slot_count - (uint32_t)used : 0;
+    uint32_t n = count < space ? count : space;
+    uint64_t now = cpu_trap_now_ns();
+
+    for (uint32_t i = 0; i < n; i++) {
+        const packet_buffer_t *pkt = pkts[i];
+        cpu_trap_record_t *rec = (cpu_trap_record_t *)((uint8_t *)hdr + hdr->slots_offset +
+                                                       (size_t)(head & (hdr->slot_count - 1)) * hdr->slot_size);
+        uint32_t len = packet_chain_length(pkt);
+        uint32_t cap = len < hdr->snaplen ? len : hdr->snaplen;
+        uint32_t off = 0;
+
+        for (const packet_buffer_t *seg = pkt; seg && off < cap; seg = seg->next) {
+            uint32_t take = cap - off < seg->length ? cap - off : seg->length;
+            memcpy(rec->data + off, seg->data, take);
+            off += take;
+        }
+
+        rec->timestamp_ns = now;
+        rec->orig_len = len;
+        rec->cap_len = cap;
+        rec->port = pkt->metadata.port;
+        rec->vlan = pkt->metadata.vlan;
+        rec->reason = (uint16_t)reason;
+        rec->flags = cap < len ? CPU_TRAP_FLAG_TRUNCATED : 0;
+        truncated += cap < len;
+        head++;
+    }
+    written = n;
+
+    // Records first, then the head that makes them visible
+    __atomic_store_n(&hdr->head, head, __ATOMIC_RELEASE);
+    __atomic_store_n(&hdr->trapped[reason], hdr->trapped[reason] + written, __ATOMIC_RELAXED);
+    __atomic_store_n(&hdr->truncated, hdr->truncated + truncated, __ATOMIC_RELAXED);
+    __atomic_store_n(&hdr->ring_full, hdr->ring_full + (count - written), __ATOMIC_RELAXED);
+    spinlock_release(&g_cpu_trap.lock);
+
+    return written;
+}
+
+status_t cpu_trap_get_stats(cpu_trap_stats_t *stats) {
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_cpu_trap.lock);
+    cpu_trap_header_t *hdr = g_cpu_trap.hdr;
+    if (!hdr) {
+        spinlock_release(&g_cpu_trap.lock);
+        return STATUS_NOT_INITIALIZED;
+    }
+    for (uint32_t i = 0; i < CPU_TRAP_REASON_COUNT; i++) {
+        stats->trapped[i] = hdr->trapped[i];
+    }
+    stats->ring_full = hdr->ring_full;
+    stats->truncated = hdr->truncated;
+    uint64_t used = hdr->head - __atomic_load_n(&hdr->tail, __ATOMIC_ACQUIRE);
+    stats->depth = used <= hdr->slot_count ? (uint32_t)used : hdr->slot_count;
+    spinlock_release(&g_cpu_trap.lock);
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,771 @@
+/**
+ * @file forwarding.c
+ * @brief Multi-core forwarding engine implementation
+ *
+ * Worker w owns the RX rings of ports p with p % N == w. For every packet
+ * it takes from those rings it computes the flow hash and either keeps
+ * the packet or stages it for the worker that owns the hash. Staged
+ * packets move through an SPSC ring per (source, destination) worker
+ * pair, so no queue ever has more than one producer or consumer. The
+ * worker also drains the TX rings of the ports it owns, on which any
+ * worker may queue.
+ *
+ * An idle worker goes from spinning to pause backoff to blocking on its
+ * eventfd. Before it blocks it sets its sleeping flag and polls once
+ * more; whoever queues packets for it checks the flag after queuing,
+ * with a full fence on both sides, so either the worker sees the packets
+ * or the producer sees the flag and signals.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "../../include/hal/forwarding.h"
+#include "../../include/hal/hw_simulation.h"
+#include "../../include/hal/packet_ring.h"
+#include "../../include/hal/packet_drop.h"
+#include "../../include/common/config.h"
+#include "../../include/common/logging.h"
+#include "../../include/common/rcu.h"
+#include "../../include/common/sim_numa.h"
+#include "../../include/common/threading.h"
+
+/**
+ * @brief Most cpu_relax() hints between two poll rounds in pause backoff
+ */
+#define FWD_IDLE_PAUSE_MAX      64
+
+/**
+ * @brief Empty poll rounds after which the time in the idle state is added up
+ *
+ * A power of two.
+ */
+#define FWD_IDLE_ACCOUNT_POLLS  1024
+
+/**
+ * @brief What a worker does between poll rounds
+ */
+typedef enum {
+    FWD_IDLE_BUSY,                      /**< The last round found work */
+    FWD_IDLE_SPIN,                      /**< Re-polling at once */
+    FWD_IDLE_PAUSE,                     /**< Pausing between rounds */
+    FWD_IDLE_BLOCK                      /**< Blocking on the eventfd between rounds */
+} fwd_idle_state_t;
+
+/**
+ * @brief Wakeup of one worker
+ *
+ * Kept apart from the worker state, on its own cache line, and never
+ * freed: a producer may still hold it after the engine stopped, and the
+ * eventfd stays open for whichever engine starts next.
+ */
+typedef struct __attribute__((aligned(64))) {
+    int fd;                             /**< eventfd the worker blocks on, -1 until created */
+    bool sleeping;                      /**< The worker is about to block or blocked */
+} fwd_waiter_t;
+
+/**
+ * @brief Worker thread state
+ */
+typedef struct {
+    pthread_t thread;                   /**< Thread handle */
+    uint32_t index;                     /**< Worker index */
+    bool started;                       /**< Thread was created */
+    port_id_t *ports;                   /**< Port RX rings drained by this worker */
+    uint32_t port_count;                /**< Number of owned ports */
+    packet_ring_t **inbox;              /**< inbox[src]: packets from worker src */
+    packet_buffer_t **stage;            /**< Per destination staging, burst_size each */
+    uint32_t *stage_count;              /**< Packets staged per destination */
+    packet_buffer_t **local;            /**< Packets to run on this worker */
+    uint32_t local_count;               /**< Packets in local */
+    fwd_waiter_t *waiter;               /**< Wakeup of this worker */
+    fwd_idle_state_t idle_state;        /**< State since idle_since */
+    uint64_t idle_since;                /**< Monotonic nanoseconds the state was last accounted at */
+    uint64_t empty_polls;               /**< Poll rounds in a row that found no work */
+    uint32_t pause;                     /**< cpu_relax() hints between rounds in pause backoff */
+    bool armed;                         /**< The sleeping flag is set, one more round before blocking */
+    forwarding_worker_stats_t stats;    /**< Counters (written by the worker only) */
+} fwd_worker_t;
+
+/**
+ * @brief Forwarding engine state
+ */
+static struct {
+    bool initialized;
+    volatile bool running;
+    uint32_t num_workers;
+    uint32_t burst_size;
+    uint32_t idle_spin_polls;
+    uint32_t idle_pause_polls;
+    bool idle_block;
+    fwd_worker_t *workers;
+} g_fwd = {0};
+
+static fwd_waiter_t g_fwd_waiters[CONFIG_MAX_WORKER_THREADS] = {
+    [0 ... CONFIG_MAX_WORKER_THREADS - 1] = { .fd = -1 },
+};
+
+/**
+ * @brief Index of the worker running on this thread, UINT32_MAX elsewhere
+ */
+static __thread uint32_t t_fwd_worker = UINT32_MAX;
+
+/**
+ * @brief Map a flow hash to a worker without a division
+ */
+static inline uint32_t fwd_hash_to_worker(uint32_t flow_hash) {
+    return (uint32_t)(((uint64_t)flow_hash * g_fwd.num_workers) >> 32);
+}
+
+/**
+ * @brief Add to a counter of this worker's stats
+ *
+ * Only the owning worker writes, so a relaxed store is enough for
+ * forwarding_get_worker_stats() to read it from another thread.
+ */
+static inline void fwd_count(uint64_t *counter, uint64_t value) {
+    __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t fwd_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Wake a worker if it is going to block or blocked
+ *
+ * Called after packets were queued for it.
+ *
+ * @param waiter Wakeup of the worker
+ */
+static void fwd_wake(fwd_waiter_t *waiter) {
+    // Orders the queued packets before the look at the flag
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&waiter->sleeping, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(&waiter->sleeping, false, __ATOMIC_RELAXED)) {
+        uint64_t one = 1;
+        if (write(waiter->fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            LOG_WARNING(LOG_CATEGORY_HAL, "Failed to wake a forwarding worker: %s", strerror(errno));
+        }
+    }
+}
+
+/**
+ * @brief RX ring notification of the ports a worker drains
+ */
+static void fwd_rx_notify(port_id_t port_id, void *user_data) {
+    (void)port_id;
+    fwd_wake((fwd_waiter_t *)user_data);
+}
+
+/**
+ * @brief Add the time since the last accounting to the current idle state
+ *
+ * @param worker Worker state
+ * @param next State from now on
+ */
+static void fwd_idle_account(fwd_worker_t *worker, fwd_idle_state_t next) {
+    uint64_t now = fwd_now_ns();
+    uint64_t elapsed = now - worker->idle_since;
+
+    switch (worker->idle_state) {
+    case FWD_IDLE_SPIN:
+        fwd_count(&worker->stats.spin_ns, elapsed);
+        break;
+    case FWD_IDLE_PAUSE:
+        fwd_count(&worker->stats.pause_ns, elapsed);
+        break;
+    case FWD_IDLE_BLOCK:
+        fwd_count(&worker->stats.block_ns, elapsed);
+        break;
+    default:
+        break;
+    }
+    worker->idle_state = next;
+    worker->idle_since = now;
+}
+
+/**
+ * @brief Go back to work after idle rounds
+ *
+ * @param worker Worker state
+ */
+static void fwd_idle_leave(fwd_worker_t *worker) {
+    if (worker->armed) {
+        // A producer that took the flag meanwhile leaves a spurious wakeup behind
+        __atomic_store_n(&worker->waiter->sleeping, false, __ATOMIC_RELAXED);
+        worker->armed = false;
+    }
+    fwd_idle_account(worker, FWD_IDLE_BUSY);
+    worker->empty_polls = 0;
+}
+
+/**
+ * @brief Block until packets are queued for the worker or the timeout passes
+ *
+ * @param worker Worker state, armed
+ */
+static void fwd_idle_block(fwd_worker_t *worker) {
+    struct pollfd pfd = { .fd = worker->waiter->fd, .events = POLLIN };
+    uint64_t value;
+
+    if (worker->idle_state != FWD_IDLE_BLOCK) {
+        fwd_idle_account(worker, FWD_IDLE_BLOCK);
+    }
+    fwd_count(&worker->stats.blocks, 1);
+
+    rcu_worker_offline();
+    if (poll(&pfd, 1, CONFIG_FWD_IDLE_BLOCK_MS) > 0) {
+        if (read(pfd.fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+            LOG_WARNING(LOG_CATEGORY_HAL, "Failed to read forwarding worker %u eventfd: %s",
+                        worker->index, strerror(errno));
+        }
+        fwd_count(&worker->stats.wakeups, 1);
+    }
+    rcu_worker_online();
+
+    __atomic_store_n(&worker->waiter->sleeping, false, __ATOMIC_RELAXED);
+    worker->armed = false;
+    fwd_idle_account(worker, FWD_IDLE_BLOCK);
+}
+
+/**
+ * @brief Wait after a poll round that found no work
+ *
+ * @param worker Worker state
+ */
+static void fwd_idle(fwd_worker_t *worker) {
+    uint64_t empty = ++worker->empty_polls;
+
+    if (worker->idle_state == FWD_IDLE_BUSY) {
+        fwd_idle_account(worker, FWD_IDLE_SPIN);
+    } else if ((empty & (FWD_IDLE_ACCOUNT_POLLS - 1)) == 0) {
+        fwd_idle_account(worker, worker->idle_state);
+    }
+
+    if (empty <= g_fwd.idle_spin_polls) {
+        return;
+    }
+
+    if (!g_fwd.idle_block || empty - g_fwd.idle_spin_polls <= g_fwd.idle_pause_polls) {
+        if (worker->idle_state != FWD_IDLE_PAUSE) {
+            fwd_idle_account(worker, FWD_IDLE_PAUSE);
+            worker->pause = 1;
+        }
+        for (uint32_t i = 0; i < worker->pause; i++) {
+            cpu_relax();
+        }
+        if (worker->pause < FWD_IDLE_PAUSE_MAX) {
+            worker->pause <<= 1;
+        }
+        return;
+    }
+
+    // Poll once more with the flag set, then block
+    if (!worker->armed) {
+        __atomic_store_n(&worker->waiter->sleeping, true, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        worker->armed = true;
+        return;
+    }
+    fwd_idle_block(worker);
+}
+
+/**
+ * @brief Run the worker's local batch through the pipeline
+ *
+ * @param worker Worker state
+ */
+static void fwd_process_local(fwd_worker_t *worker) {
+    packet_result_t results[PACKET_BURST_MAX];
+    uint32_t n = worker->local_count;
+
+    if (n == 0) {
+        return;
+    }
+
+    if (packet_process_burst(worker->local, n, results) != STATUS_SUCCESS) {
+        for (uint32_t i = 0; i < n; i++) {
+            results[i] = PACKET_RESULT_DROP;
+        }
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (results[i] != PACKET_RESULT_CONSUME) {
+            packet_buffer_free(worker->local[i]);
+        }
+    }
+
+    fwd_count(&worker->stats.processed, n);
+    worker->local_count = 0;
+}
+
+/**
+ * @brief Add a packet to the worker's local batch
+ *
+ * @param worker Worker state
+ * @param packet Packet to process on this worker
+ */
+static inline void fwd_add_local(fwd_worker_t *worker, packet_buffer_t *packet) {
+    if (worker->local_count == g_fwd.burst_size) {
+        fwd_process_local(worker);
+    }
+    worker->local[worker->local_count++] = packet;
+}
+
+/**
+ * @brief Hand staged packets to a destination worker
+ *
+ * @param worker Source worker
+ * @param dest Destination worker index
+ */
+static void fwd_flush_stage(fwd_worker_t *worker, uint32_t dest) {
+    uint32_t n = worker->stage_count[dest];
+    packet_buffer_t **pkts = worker->stage + (size_t)dest * g_fwd.burst_size;
+
+    if (n == 0) {
+        return;
+    }
+
+    uint32_t queued = packet_ring_enqueue_burst(g_fwd.workers[dest].inbox[worker->index], pkts, n);
+    if (queued && g_fwd.idle_block) {
+        fwd_wake(g_fwd.workers[dest].waiter);
+    }
+    for (uint32_t i = queued; i < n; i++) {
+        packet_drop_count(pkts[i], PACKET_DROP_DISPATCH_FULL);
+        packet_buffer_free(pkts[i]);
+    }
+
+    fwd_count(&worker->stats.dispatched, queued);
+    fwd_count(&worker->stats.dispatch_drops, n - queued);
+    worker->stage_count[dest] = 0;
+}
+
+/**
+ * @brief Dispatch a packet taken from a port RX ring by flow hash
+ *
+ * @param worker Worker that took the packet
+ * @param packet Received packet
+ */
+static inline void fwd_dispatch(fwd_worker_t *worker, packet_buffer_t *packet) {
+    uint32_t dest = fwd_hash_to_worker(packet_flow_hash(packet));
+
+    if (dest == worker->index) {
+        fwd_add_local(worker, packet);
+        return;
+    }
+
+    if (worker->stage_count[dest] == g_fwd.burst_size) {
+        fwd_flush_stage(worker, dest);
+    }
+    worker->stage[(size_t)dest * g_fwd.burst_size + worker->stage_count[dest]++] = packet;
+}
+
+/**
+ * @brief Worker thread main loop
+ *
+ * @param arg Worker state
+ * @return NULL
+ */
+static void *fwd_worker_main(void *arg) {
+    fwd_worker_t *worker = (fwd_worker_t *)arg;
+    packet_buffer_t *pkts[PACKET_BURST_MAX];
+
+    t_fwd_worker = worker->index;
+    LOG_INFO(LOG_CATEGORY_HAL, "Forwarding worker %u started (%u ports, cpu %d)",
+             worker->index, worker->port_count, worker->stats.cpu);
+
+    // Without QSBR the pipeline stages still take their own read sections
+    if (rcu_register_worker() != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_HAL, "Forwarding worker %u runs without QSBR", worker->index);
+    }
+    worker->idle_state = FWD_IDLE_BUSY;
+    worker->idle_since = fwd_now_ns();
+
+    while (__atomic_load_n(&g_fwd.running, __ATOMIC_ACQUIRE)) {
+        uint64_t work = 0;
+
+        // Nothing from the previous round is still referenced
+        rcu_quiescent_state();
+
+        // Drain owned port RX rings and spread packets by flow
+        for (uint32_t p = 0; p < worker->port_count; p++) {
+            uint32_t n = hw_sim_rx_dequeue_burst(worker->ports[p], pkts, g_fwd.burst_size);
+            for (uint32_t i = 0; i < n; i++) {
+                fwd_dispatch(worker, pkts[i]);
+            }
+            fwd_count(&worker->stats.rx_packets, n);
+            work += n;
+        }
+
+        for (uint32_t w = 0; w < g_fwd.num_workers; w++) {
+            fwd_flush_stage(worker, w);
+        }
+
+        // Collect packets other workers dispatched to us
+        for (uint32_t src = 0; src < g_fwd.num_workers; src++) {
+            if (src == worker->index) {
+                continue;
+            }
+            uint32_t n = packet_ring_dequeue_burst(worker->inbox[src], pkts, g_fwd.burst_size);
+            for (uint32_t i = 0; i < n; i++) {
+                fwd_add_local(worker, pkts[i]);
+            }
+            work += n;
+        }
+
+        fwd_process_local(worker);
+
+        // Send what this round and the other workers queued on owned ports
+        for (uint32_t p = 0; p < worker->port_count; p++) {
+            work += hw_sim_tx_drain(worker->ports[p], g_fwd.burst_size);
+        }
+
+        if (work != 0) {
+            if (worker->idle_state != FWD_IDLE_BUSY) {
+                fwd_idle_leave(worker);
+            }
+            continue;
+        }
+        fwd_count(&worker->stats.idle_polls, 1);
+        fwd_idle(worker);
+    }
+
+    fwd_idle_leave(worker);
+    rcu_unregister_worker();
+
+    LOG_INFO(LOG_CATEGORY_HAL, "Forwarding worker %u stopped", worker->index);
+    return NULL;
+}
+
+/**
+ * @brief Free the queues and buffers of all workers
+ */
+static void fwd_free_workers(void) {
+    if (!g_fwd.workers) {
+        return;
+    }
+
+    for (uint32_t w = 0; w < g_fwd.num_workers; w++) {
+        fwd_worker_t *worker = &g_fwd.workers[w];
+        if (worker->inbox) {
+            for (uint32_t src = 0; src < g_fwd.num_workers; src++) {
+                packet_ring_destroy(worker->inbox[src]);
+            }
+        }
+        free(worker->inbox);
+        free(worker->ports);
+        free(worker->stage);
+        free(worker->stage_count);
+        free(worker->local);
+    }
+
+    free(g_fwd.workers);
+    g_fwd.workers = NULL;
+}
+
+/**
+ * @brief Stop and join the started workers, then free all worker state
+ */
+static void fwd_stop_workers(void) {
+    uint64_t one = 1;
+
+    __atomic_store_n(&g_fwd.running, false, __ATOMIC_RELEASE);
+    for (uint32_t w = 0; w < g_fwd.num_workers; w++) {
+        fwd_worker_t *worker = &g_fwd.workers[w];
+
+        // Blocked workers see the stop without waiting for the timeout
+        if (worker->waiter && worker->waiter->fd >= 0 &&
+            write(worker->waiter->fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            LOG_WARNING(LOG_CATEGORY_HAL, "Failed to wake forwarding worker %u: %s", w, strerror(errno));
+        }
+        for (uint32_t p = 0; p < worker->port_count; p++) {
+            hw_sim_rx_ring_set_notify(worker->ports[p], NULL, NULL);
+        }
+    }
+    for (uint32_t w = 0; w < g_fwd.num_workers; w++) {
+        if (g_fwd.workers[w].started) {
+            pthread_join(g_fwd.workers[w].thread, NULL);
+            g_fwd.workers[w].started = false;
+        }
+    }
+
+    fwd_free_workers();
+    g_fwd.num_workers = 0;
+}
+
+/**
+ * @brief Fill a configuration with defaults
+ *
+ * @param[out] config Configuration to fill
+ */
+void forwarding_get_default_config(forwarding_config_t *config) {
+    if (!config) {
+        return;
+    }
+
+    config->num_workers = CONFIG_WORKER_THREADS;
+    config->burst_size = PACKET_BURST_MAX;
+    config->pin_workers = true;
+    config->first_cpu = 0;
+    config->cpu_list = CONFIG_WORKER_CPU_LIST;
+    config->idle_spin_polls = CONFIG_FWD_IDLE_SPIN_POLLS;
+    config->idle_pause_polls = CONFIG_FWD_IDLE_PAUSE_POLLS;
+    config->idle_block = CONFIG_FWD_IDLE_BLOCK;
+}
+
+/**
+ * @brief Create the worker pool and start forwarding
+ *
+ * @param config Configuration (NULL for defaults)
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t forwarding_init(const forwarding_config_t *config) {
+    forwarding_config_t defaults;
+    uint32_t port_count = 0;
+
+    if (g_fwd.initialized) {
+        LOG_WARNING(LOG_CATEGORY_HAL, "Forwarding engine already initialized");
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    if (!config) {
+        forwarding_get_default_config(&defaults);
+        config = &defaults;
+    }
+
+    status_t status = hw_sim_get_port_count(&port_count);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Forwarding engine needs the hardware simulation");
+        return status;
+    }
+
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t cpus = online > 0 ? (uint32_t)online : 1;
+    uint32_t cpu_list[CONFIG_MAX_WORKER_THREADS];
+    uint32_t cpu_list_len = 0;
+
+    if (config->pin_workers && config->cpu_list) {
+        cpu_list_len = sim_numa_parse_cpu_list(config->cpu_list, cpu_list, CONFIG_MAX_WORKER_THREADS);
+        if (cpu_list_len == 0) {
+            LOG_ERROR(LOG_CATEGORY_HAL, "Invalid forwarding CPU list '%s'", config->cpu_list);
+            return STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    // A CPU list sets the worker count unless one is given
+    uint32_t num_workers = config->num_workers ? config->num_workers : (cpu_list_len ? cpu_list_len : cpus);
+    if (num_workers > CONFIG_MAX_WORKER_THREADS) {
+        num_workers = CONFIG_MAX_WORKER_THREADS;
+    }
+
+    uint32_t burst = config->burst_size;
+    if (burst == 0 || burst > PACKET_BURST_MAX) {
+        burst = PACKET_BURST_MAX;
+    }
+
+    g_fwd.num_workers = num_workers;
+    g_fwd.burst_size = burst;
+    g_fwd.idle_spin_polls = config->idle_spin_polls;
+    g_fwd.idle_pause_polls = config->idle_pause_polls;
+    g_fwd.idle_block = config->idle_block;
+    g_fwd.workers = (fwd_worker_t *)calloc(num_workers, sizeof(fwd_worker_t));
+    if (!g_fwd.workers) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate forwarding workers");
+        return STATUS_NO_MEMORY;
+    }
+
+    // Allocate queues and assign port RX rings round-robin
+    for (uint32_t w = 0; w < num_workers; w++) {
+        fwd_worker_t *worker = &g_fwd.workers[w];
+        worker->index = w;
+        worker->waiter = &g_fwd_waiters[w];
+        worker->waiter->sleeping = false;
+        worker->stats.cpu = -1;
+        if (config->pin_workers) {
+            worker->stats.cpu = (int32_t)(cpu_list_len ? cpu_list[w % cpu_list_len] : (config->first_cpu + w) % cpus);
+            worker->stats.node = sim_numa_node_of_cpu((uint32_t)worker->stats.cpu);
+        }
+        worker->inbox = (packet_ring_t **)calloc(num_workers, sizeof(packet_ring_t *));
+        worker->ports = (port_id_t *)calloc(port_count / num_workers + 1, sizeof(port_id_t));
+        worker->stage = (packet_buffer_t **)calloc((size_t)num_workers * burst, sizeof(packet_buffer_t *));
+        worker->stage_count = (uint32_t *)calloc(num_workers, sizeof(uint32_t));
+        worker->local = (packet_buffer_t **)calloc(burst, sizeof(packet_buffer_t *));
+        if (!worker->inbox || !worker->ports || !worker->stage || !worker->stage_count || !worker->local) {
+            LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate forwarding worker %u", w);
+            fwd_free_workers();
+            return STATUS_NO_MEMORY;
+        }
+        if (config->idle_block && worker->waiter->fd < 0) {
+            worker->waiter->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (worker->waiter->fd < 0) {
+                LOG_ERROR(LOG_CATEGORY_HAL, "Failed to create forwarding worker %u eventfd: %s",
+                          w, strerror(errno));
+                fwd_free_workers();
+                return STATUS_NO_MEMORY;
+            }
+        }
+
+        for (uint32_t src = 0; src < num_workers; src++) {
+            if (src == w) {
+                continue;
+            }
+            worker->inbox[src] = packet_ring_create(CONFIG_MAX_QUEUE_DEPTH);
+            if (!worker->inbox[src]) {
+                LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate queue %u -> %u", src, w);
+                fwd_free_workers();
+                return STATUS_NO_MEMORY;
+            }
+            // A queue is read by its destination, written a burst at a time by its source
+            sim_numa_bind_memory(worker->inbox[src], packet_ring_bytes(CONFIG_MAX_QUEUE_DEPTH),
+                                 worker->stats.node);
+        }
+        sim_numa_bind_memory(worker->stage, (size_t)num_workers * burst * sizeof(packet_buffer_t *),
+                             worker->stats.node);
+    }
+
+    for (port_id_t port = 0; port < port_count; port++) {
+        fwd_worker_t *worker = &g_fwd.workers[port % num_workers];
+        worker->ports[worker->port_count++] = port;
+        if (config->pin_workers) {
+            hw_sim_rx_ring_set_node(port, worker->stats.node);
+        }
+        if (config->idle_block) {
+            hw_sim_rx_ring_set_notify(port, fwd_rx_notify, worker->waiter);
+        }
+    }
+
+    // Start workers
+    __atomic_store_n(&g_fwd.running, true, __ATOMIC_RELEASE);
+    for (uint32_t w = 0; w < num_workers; w++) {
+        fwd_worker_t *worker = &g_fwd.workers[w];
+        worker->stats.ports = worker->port_count;
+
+        int rc = -1;
+        if (config->pin_workers) {
+            pthread_attr_t attr;
+            cpu_set_t set;
+
+            CPU_ZERO(&set);
+            CPU_SET(worker->stats.cpu, &set);
+            pthread_attr_init(&attr);
+            if (pthread_attr_setaffinity_np(&attr, sizeof(set), &set) == 0) {
+                rc = pthread_create(&worker->thread, &attr, fwd_worker_main, worker);
+            }
+            pthread_attr_destroy(&attr);
+
+            if (rc != 0) {
+                LOG_WARNING(LOG_CATEGORY_HAL, "Failed to pin forwarding worker %u to cpu %d",
+                            w, worker->stats.cpu);
+                worker->stats.cpu = -1;
+            }
+        }
+
+        if (rc != 0) {
+            rc = pthread_create(&worker->thread, NULL, fwd_worker_main, worker);
+        }
+
+        if (rc != 0) {
+            LOG_ERROR(LOG_CATEGORY_HAL, "Failed to start forwarding worker %u", w);
+            fwd_stop_workers();
+            return STATUS_FAILURE;
+        }
+        worker->started = true;
+    }
+
+    g_fwd.initialized = true;
+    LOG_INFO(LOG_CATEGORY_HAL, "Forwarding engine started with %u workers for %u ports",
+             num_workers, port_count);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Stop and join all workers and free the worker queues
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not running
+ */
+status_t forwarding_shutdown(void) {
+    if (!g_fwd.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    fwd_stop_workers();
+    g_fwd.initialized = false;
+
+    LOG_INFO(LOG_CATEGORY_HAL, "Forwarding engine stopped");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the number of running workers
+ *
+ * @return Worker count (0 if not running)
+ */
+uint32_t forwarding_get_worker_count(void) {
+    return g_fwd.initialized ? g_fwd.num_workers : 0;
+}
+
+/**
+ * @brief Get the worker that processes a flow hash
+ *
+ * @param flow_hash Hash from packet_flow_hash()
+ * @return Worker index
+ */
+uint32_t forwarding_worker_for_hash(uint32_t flow_hash) {
+    return g_fwd.num_workers ? fwd_hash_to_worker(flow_hash) : 0;
+}
+
+/**
+ * @brief Get the worker running on the calling thread
+ *
+ * @return Worker index, UINT32_MAX if the caller is not a worker
+ */
+uint32_t forwarding_current_worker(void) {
+    return t_fwd_worker;
+}
+
+/**
+ * @brief Get counters of one worker
+ *
+ * Counters are read without stopping the worker and may be slightly stale.
+ *
+ * @param worker Worker index
+ * @param[out] stats Worker counters
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t forwarding_get_worker_stats(uint32_t worker, forwarding_worker_stats_t *stats) {
+    if (!g_fwd.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (worker >= g_fwd.num_workers || !stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    const forwarding_worker_stats_t *src = &g_fwd.workers[worker].stats;
+    stats->rx_packets = __atomic_load_n(&src->rx_packets, __ATOMIC_RELAXED);
+    stats->dispatched = __atomic_load_n(&src->dispatched, __ATOMIC_RELAXED);
+    stats->processed = __atomic_load_n(&src->processed, __ATOMIC_RELAXED);
+    stats->dispatch_drops = __atomic_load_n(&src->dispatch_drops, __ATOMIC_RELAXED);
+    stats->idle_polls = __atomic_load_n(&src->idle_polls, __ATOMIC_RELAXED);
+    stats->spin_ns = __atomic_load_n(&src->spin_ns, __ATOMIC_RELAXED);
+    stats->pause_ns = __atomic_load_n(&src->pause_ns, __ATOMIC_RELAXED);
+    stats->block_ns = __atomic_load_n(&src->block_ns, __ATOMIC_RELAXED);
+    stats->blocks = __atomic_load_n(&src->blocks, __ATOMIC_RELAXED);
+    stats->wakeups = __atomic_load_n(&src->wakeups, __ATOMIC_RELAXED);
+    stats->ports = src->ports;
+    stats->cpu = src->cpu;
+    stats->node = src->node;
+    return STATUS_SUCCESS;
+}
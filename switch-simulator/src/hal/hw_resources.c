@@ -0,0 +1,291 @@
+/**
+ * @file hw_resources.c
+ * @brief Hardware resources accounting for switch simulator
+ *
+ * Packet buffers and the MAC table are counted by the modules that own
+ * them; every other resource is a fixed budget that callers reserve and
+ * release. The routing table reserves an entry for each route it
+ * programs into the hardware.
+ */
+
+#include <string.h>
+#include <pthread.h>
+
+#include "../../include/hal/hw_resources.h"
+#include "../../include/hal/packet.h"
+#include "../../include/hal/qos.h"
+#include "../../include/l2/mac_table.h"
+#include "../../include/l3/acl.h"
+#include "../../include/common/config.h"
+#include "../../include/common/logging.h"
+
+/** Number of resource types */
+#define HW_RESOURCE_TYPES   (HW_RESOURCE_QUEUE + 1)
+
+/** Routes the FIB can index */
+#define HW_MAX_ROUTES       0x007FFFFFU
+
+/**
+ * @brief Budget of one resource type
+ */
+typedef struct {
+    uint32_t total;         /**< Resources of the device */
+    uint32_t reserved;      /**< Taken with hw_resources_reserve() */
+    const char *arena;      /**< Memory arena holding the resource, NULL if none */
+} hw_resource_budget_t;
+
+static struct {
+    pthread_mutex_t lock;
+    bool initialized;
+    hw_resource_budget_t budget[HW_RESOURCE_TYPES];
+} g_hw_resources = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/**
+ * @brief Initialize hardware resources
+ *
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_resources_init(void) {
+    pthread_mutex_lock(&g_hw_resources.lock);
+    if (g_hw_resources.initialized) {
+        pthread_mutex_unlock(&g_hw_resources.lock);
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    memset(g_hw_resources.budget, 0, sizeof(g_hw_resources.budget));
+    g_hw_resources.budget[HW_RESOURCE_PORT].total = CONFIG_MAX_PORTS;
+    g_hw_resources.budget[HW_RESOURCE_BUFFER].arena = "packet_pool";
+    g_hw_resources.budget[HW_RESOURCE_MAC_TABLE].total = CONFIG_MAX_MAC_TABLE_ENTRIES;
+    g_hw_resources.budget[HW_RESOURCE_MAC_TABLE].arena = "mac_table";
+    g_hw_resources.budget[HW_RESOURCE_VLAN_TABLE].total = CONFIG_MAX_VLANS;
+    g_hw_resources.budget[HW_RESOURCE_ROUTE_TABLE].total = HW_MAX_ROUTES;
+    g_hw_resources.budget[HW_RESOURCE_ROUTE_TABLE].arena = "fib";
+    g_hw_resources.budget[HW_RESOURCE_ACL].total = ACL_MAX_RULES;
+    // One hit counter per ACL rule
+    g_hw_resources.budget[HW_RESOURCE_COUNTER].total = ACL_MAX_RULES;
+    g_hw_resources.budget[HW_RESOURCE_QUEUE].total = CONFIG_MAX_PORTS * QOS_QUEUES_PER_PORT;
+    g_hw_resources.initialized = true;
+    pthread_mutex_unlock(&g_hw_resources.lock);
+
+    LOG_INFO(LOG_CATEGORY_HAL, "Hardware resources initialized");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Shutdown hardware resources
+ *
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_resources_shutdown(void) {
+    pthread_mutex_lock(&g_hw_resources.lock);
+    g_hw_resources.initialized = false;
+    pthread_mutex_unlock(&g_hw_resources.lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Count what the owning module has in use
+ *
+ * @param resource Resource type
+ * @param[in,out] usage Usage; total is replaced when the module knows better
+ */
+static void hw_resources_count_used(hw_resource_type_t resource, hw_resource_usage_t *usage) {
+    switch (resource) {
+    case HW_RESOURCE_BUFFER: {
+        packet_pool_stats_t pool;
+        if (packet_get_pool_stats(&pool) == STATUS_SUCCESS) {
+            usage->total = pool.pool_size + pool.seg_pool_size;
+            usage->used = pool.in_use + pool.seg_in_use;
+        }
+        break;
+    }
+    case HW_RESOURCE_MAC_TABLE: {
+        hw_resource_usage_t mac;
+        if (mac_table_get_resource_usage(&mac) == STATUS_SUCCESS) {
+            usage->total = mac.total;
+            usage->used = mac.used;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Get hardware resource usage
+ *
+ * @param resource Resource type
+ * @param[out] usage Resource usage information
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_resources_get_usage(hw_resource_type_t resource, hw_resource_usage_t *usage) {
+    hw_resource_budget_t budget;
+
+    if ((uint32_t)resource >= HW_RESOURCE_TYPES || !usage) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_hw_resources.lock);
+    if (!g_hw_resources.initialized) {
+        pthread_mutex_unlock(&g_hw_resources.lock);
+        return STATUS_NOT_INITIALIZED;
+    }
+    budget = g_hw_resources.budget[resource];
+    pthread_mutex_unlock(&g_hw_resources.lock);
+
+    memset(usage, 0, sizeof(*usage));
+    usage->total = budget.total;
+    usage->reserved = budget.reserved;
+    hw_resources_count_used(resource, usage);
+
+    uint64_t taken = (uint64_t)usage->used + usage->reserved;
+    usage->available = taken < usage->total ? usage->total - (uint32_t)taken : 0;
+
+    // An arena nothing has allocated from yet is reported as all zero
+    if (budget.arena) {
+        mem_arena_get_stats_by_name(budget.arena, &usage->arena);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get hardware capabilities
+ *
+ * @param[out] capabilities Hardware capabilities information
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_resources_get_capabilities(hw_capabilities_t *capabilities) {
+    if (!capabilities) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(capabilities, 0, sizeof(*capabilities));
+    capabilities->l2_switching = true;
+    capabilities->l3_routing = true;
+    capabilities->vlan_filtering = true;
+    capabilities->qos = true;
+    capabilities->acl = true;
+    capabilities->link_aggregation = true;
+    capabilities->jumbo_frames = CONFIG_MAX_PACKET_SIZE > 1518;
+    capabilities->ipv6 = true;
+    capabilities->multicast = true;
+    capabilities->mirroring = true;
+    capabilities->max_ports = CONFIG_MAX_PORTS;
+    capabilities->max_vlans = CONFIG_MAX_VLANS;
+    capabilities->max_mac_entries = CONFIG_MAX_MAC_TABLE_ENTRIES;
+    capabilities->max_routes = HW_MAX_ROUTES;
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Size the budget of a resource type from the board profile
+ *
+ * @param resource Resource type
+ * @param total Resources of the board
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_resources_set_total(hw_resource_type_t resource, uint32_t total) {
+    status_t status = STATUS_SUCCESS;
+
+    if ((uint32_t)resource >= HW_RESOURCE_TYPES) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_hw_resources.lock);
+    if (!g_hw_resources.initialized) {
+        status = STATUS_NOT_INITIALIZED;
+    } else if (g_hw_resources.budget[resource].reserved > total) {
+        status = STATUS_RESOURCE_BUSY;
+    } else {
+        g_hw_resources.budget[resource].total = total;
+    }
+    pthread_mutex_unlock(&g_hw_resources.lock);
+
+    return status;
+}
+
+/**
+ * @brief Reserve hardware resources
+ *
+ * @param resource Resource type
+ * @param amount Amount to reserve
+ * @return status_t STATUS_SUCCESS if successful, STATUS_RESOURCE_EXHAUSTED
+ *         if fewer than amount are available
+ */
+status_t hw_resources_reserve(hw_resource_type_t resource, uint32_t amount) {
+    hw_resource_usage_t usage;
+    status_t status = hw_resources_get_usage(resource, &usage);
+
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    pthread_mutex_lock(&g_hw_resources.lock);
+    hw_resource_budget_t *budget = &g_hw_resources.budget[resource];
+    // Reservations made since the usage was read count too
+    uint64_t taken = (uint64_t)usage.used + budget->reserved + amount;
+    if (taken > usage.total) {
+        status = STATUS_RESOURCE_EXHAUSTED;
+    } else {
+        budget->reserved += amount;
+    }
+    pthread_mutex_unlock(&g_hw_resources.lock);
+
+    return status;
+}
+
+/**
+ * @brief Release hardware resources
+ *
+ * @param resource Resource type
+ * @param amount Amount to release
+ * @return status_t STATUS_SUCCESS if successful, STATUS_INVALID_PARAMETER
+ *         if more than is reserved
+ */
+status_t hw_resources_release(hw_resource_type_t resource, uint32_t amount) {
+    status_t status = STATUS_SUCCESS;
+
+    if ((uint32_t)resource >= HW_RESOURCE_TYPES) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_hw_resources.lock);
+    if (!g_hw_resources.initialized) {
+        status = STATUS_NOT_INITIALIZED;
+    } else if (amount > g_hw_resources.budget[resource].reserved) {
+        status = STATUS_INVALID_PARAMETER;
+    } else {
+        g_hw_resources.budget[resource].reserved -= amount;
+    }
+    pthread_mutex_unlock(&g_hw_resources.lock);
+
+    return status;
+}
+
+/**
+ * @brief Check if hardware resources are available
+ *
+ * @param resource Resource type
+ * @param amount Amount needed
+ * @param[out] available Set to true if resources are available
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_resources_check_available(hw_resource_type_t resource, uint32_t amount, bool *available) {
+    hw_resource_usage_t usage;
+    status_t status;
+
+    if (!available) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    status = hw_resources_get_usage(resource, &usage);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    *available = usage.available >= amount;
+    return STATUS_SUCCESS;
+}
@@ -11,10 +11,57 @@
 
 #include "../../include/hal/port.h"
 #include "../../include/hal/packet.h"
+#include "../../include/hal/hw_simulation.h"
+#include "../../include/hal/packet_ring.h"
+#include "../../include/hal/packet_offload.h"
+#include "../../include/hal/packet_profile.h"
+#include "../../include/hal/packet_drop.h"
+#include "../../include/hal/policer.h"
+#include "../../include/hal/int_telemetry.h"
+#include "../../include/hal/qos.h"
+#include "../../include/hal/sim_timing.h"
+#include "../../include/l2/mirror.h"
+#include "../../include/common/config.h"
+#include "../../include/common/event_feed.h"
 #include "../../include/common/logging.h"
+#include "../../include/common/sim_clock.h"
+#include "../../include/common/sim_numa.h"
+#include "../../include/common/stats_shard.h"
+#include "../../include/common/threading.h"
 
 /* Private structures and definitions */
 
+#if (CONFIG_RING_BUFFER_SIZE & (CONFIG_RING_BUFFER_SIZE - 1)) != 0
+#error "CONFIG_RING_BUFFER_SIZE must be a power of two"
+#endif
+
+/** TX frame size buckets, as in port_stats_t */
+#define SIM_TX_SIZE_BUCKETS 8
+
+/**
+ * @brief Data path counters of a port, kept in per-thread shards
+ *
+ * The port lock is never taken to count; port_info_t.stats gets these
+ * folded in on read.
+ */
+typedef struct {
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t rx_unicast;
+    uint64_t rx_multicast;
+    uint64_t rx_broadcast;
+    uint64_t rx_drops;
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t tx_unicast;
+    uint64_t tx_multicast;
+    uint64_t tx_broadcast;
+    uint64_t tx_drops;
+    uint64_t tx_sizes[SIM_TX_SIZE_BUCKETS];
+} sim_port_counters_t;
+
+#define SIM_PORT_COUNTER_WORDS (sizeof(sim_port_counters_t) / sizeof(uint64_t))
+
 /**
  * @brief Internal port information structure
  */
@@ -22,6 +69,13 @@ typedef struct {
     port_info_t info;
     bool initialized;
     pthread_mutex_t lock;
+    packet_ring_t *rx_ring;     /**< Driver -> forwarding workers */
+    packet_ring_t *tx_ring;     /**< Forwarding workers -> driver */
+    spinlock_t tx_lock;         /**< Serializes the workers queueing on tx_ring */
+    hw_sim_rx_notify_t rx_notify;   /**< Wakes the drainer of rx_ring and tx_ring */
+    void *rx_notify_data;           /**< Its context */
+    uint32_t offloads;          /**< DRIVER_FLAGS_OFFLOAD of the emulated NIC */
+    uint32_t version;           /**< Bumped on every configuration or link state change */
 } sim_port_t;
 
 /**
@@ -32,6 +86,11 @@ typedef struct {
     sim_port_t ports[MAX_PORTS];
     uint32_t port_count;
     pthread_mutex_t global_lock;
+    stats_shard_set_t *counters;    /**< sim_port_counters_t of every port */
+    hw_sim_link_callback_t link_callback;   /**< Link state subscriber */
+    void *link_user_data;                   /**< Subscriber context */
+    hw_sim_rx_tap_t rx_tap;                 /**< Observer of received packets */
+    void *rx_tap_user_data;                 /**< Observer context */
 } sim_state_t;
 
 /* Static variables */
@@ -41,11 +100,16 @@ static sim_state_t g_sim_state = {0};
 static void sim_update_port_state(port_id_t port_id);
 static status_t sim_init_port(port_id_t port_id);
 static bool hw_sim_port_is_valid(port_id_t port_id);  /* Добавить сюда */
+static void sim_fold_counters(port_id_t port_id, port_stats_t *stats);
+static void sim_tx_send(port_id_t port_id, packet_buffer_t **pkts, uint32_t count);
 
-
-
-/* declarations */
-status_t hw_sim_shutdown(void);
+/**
+ * @brief Counters of a port on the calling thread
+ */
+static inline sim_port_counters_t *sim_counters(port_id_t port_id)
+{
+    return (sim_port_counters_t *)stats_shard_local(g_sim_state.counters) + port_id;
+}
 
 
 /* Implementation */
@@ -70,6 +134,38 @@ status_t hw_sim_init(void)
         return STATUS_FAILURE;
     }
 
+    /* Port counters are sharded per thread */
+    status_t shard_status = stats_shard_create(MAX_PORTS * SIM_PORT_COUNTER_WORDS,
+                                               &g_sim_state.counters);
+    if (shard_status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate port counters");
+        return shard_status;
+    }
+
+    /* Egress queues start disabled on every port */
+    status_t qos_status = qos_init();
+    if (qos_status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to initialize egress queues");
+        return qos_status;
+    }
+
+    /* The timing model is there from the start, but off until enabled */
+    status_t timing_status = sim_timing_init(sim_tx_send);
+    if (timing_status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to initialize timing model");
+        qos_shutdown();
+        return timing_status;
+    }
+
+    /* In-band telemetry is compiled in but off until configured */
+    status_t int_status = int_telemetry_init();
+    if (int_status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to initialize in-band telemetry");
+        sim_timing_shutdown();
+        qos_shutdown();
+        return int_status;
+    }
+
     /* Initialize with default port configuration */    
     g_sim_state.port_count = 24; /* Default 24 ports for simulation */
 
@@ -104,17 +200,30 @@ status_t hw_sim_shutdown(void)
         return STATUS_SUCCESS;
     }
     
+    /* Scheduled packets are dropped before the ports they would leave by go */
+    sim_timing_shutdown();
+
     pthread_mutex_lock(&g_sim_state.global_lock);
 
+    qos_shutdown();
+    int_telemetry_shutdown();
+
     /* Free resources for all ports */
     for (port_id_t i = 0; i < g_sim_state.port_count; i++) {
         if (g_sim_state.ports[i].initialized) {
+            packet_ring_destroy(g_sim_state.ports[i].rx_ring);
+            packet_ring_destroy(g_sim_state.ports[i].tx_ring);
+            g_sim_state.ports[i].rx_ring = NULL;
+            g_sim_state.ports[i].tx_ring = NULL;
+            g_sim_state.ports[i].rx_notify = NULL;
             pthread_mutex_destroy(&g_sim_state.ports[i].lock);
             g_sim_state.ports[i].initialized = false;
         }
     }
     
     g_sim_state.initialized = false;
+    stats_shard_destroy(g_sim_state.counters);
+    g_sim_state.counters = NULL;
 
     pthread_mutex_unlock(&g_sim_state.global_lock);
     pthread_mutex_destroy(&g_sim_state.global_lock);
@@ -149,10 +258,75 @@ status_t hw_sim_get_port_info(port_id_t port_id, port_info_t *info)
     memcpy(info, &port->info, sizeof(port_info_t));
 
     pthread_mutex_unlock(&port->lock);
+
+    sim_fold_counters(port_id, &info->stats);
     
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Get the operational state of a port without locking
+ *
+ * @param port_id Port identifier
+ * @param[out] state Operational state
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_sim_get_port_state(port_id_t port_id, port_state_t *state)
+{
+    if (!g_sim_state.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (port_id >= g_sim_state.port_count || !state) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    *state = __atomic_load_n(&g_sim_state.ports[port_id].info.state, __ATOMIC_RELAXED);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the statistics of a port, folded from the per-thread counters
+ *
+ * @param port_id Port identifier
+ * @param[out] stats Statistics
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_sim_get_port_stats(port_id_t port_id, port_stats_t *stats)
+{
+    if (!g_sim_state.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (port_id >= g_sim_state.port_count || !stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    sim_port_t *port = &g_sim_state.ports[port_id];
+
+    pthread_mutex_lock(&port->lock);
+    memcpy(stats, &port->info.stats, sizeof(port_stats_t));
+    pthread_mutex_unlock(&port->lock);
+
+    sim_fold_counters(port_id, stats);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the version of a port's configuration and operational state
+ *
+ * @param port_id Port identifier
+ * @return Version, 0 for an invalid port
+ */
+uint32_t hw_sim_get_port_version(port_id_t port_id)
+{
+    if (!g_sim_state.initialized || port_id >= g_sim_state.port_count) {
+        return 0;
+    }
+
+    return __atomic_load_n(&g_sim_state.ports[port_id].version, __ATOMIC_ACQUIRE);
+}
+
 /**
  * @brief Set hardware port configuration
  *
@@ -216,6 +390,125 @@ status_t hw_sim_get_port_config(port_id_t port_id, port_config_t *config)
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Count a received packet in the port statistics
+ *
+ * @param counters Port counters of the calling thread
+ * @param packet Received packet (already parsed)
+ */
+static void sim_count_rx(sim_port_counters_t *counters, const packet_buffer_t *packet)
+{
+    stats_shard_add(&counters->rx_packets, 1);
+    stats_shard_add(&counters->rx_bytes, packet_chain_length(packet));
+
+    /* Determine packet type for stats */
+    if (packet_has_proto(packet, PACKET_PROTO_L2_MCAST | PACKET_PROTO_L2_BCAST)) {
+        if (packet_has_proto(packet, PACKET_PROTO_L2_BCAST)) {
+            stats_shard_add(&counters->rx_broadcast, 1);
+        } else {
+            stats_shard_add(&counters->rx_multicast, 1);
+        }
+    } else {
+        stats_shard_add(&counters->rx_unicast, 1);
+    }
+}
+
+/**
+ * @brief Wake the thread draining the port rings, if one asked to be
+ *
+ * @param port Port with packets newly queued for it
+ * @param port_id Its ID
+ */
+static void sim_port_notify(sim_port_t *port, port_id_t port_id)
+{
+    hw_sim_rx_notify_t notify = __atomic_load_n(&port->rx_notify, __ATOMIC_ACQUIRE);
+    if (notify) {
+        notify(port_id, __atomic_load_n(&port->rx_notify_data, __ATOMIC_RELAXED));
+    }
+}
+
+/**
+ * @brief Queue a burst of received packets on the port RX ring
+ *
+ * @param port_id Ingress port ID
+ * @param pkts Received packets
+ * @param count Number of packets
+ * @return Number of packets queued (a prefix of pkts)
+ */
+uint32_t hw_sim_rx_enqueue_burst(port_id_t port_id, packet_buffer_t **pkts, uint32_t count)
+{
+    if (!g_sim_state.initialized || port_id >= g_sim_state.port_count || !pkts) {
+        return 0;
+    }
+
+    sim_port_t *port = &g_sim_state.ports[port_id];
+
+    /* The tap sees every arrival, whether or not the port takes it */
+    hw_sim_rx_tap_t tap = __atomic_load_n(&g_sim_state.rx_tap, __ATOMIC_ACQUIRE);
+    if (tap) {
+        tap(port_id, pkts, count, __atomic_load_n(&g_sim_state.rx_tap_user_data, __ATOMIC_RELAXED));
+    }
+
+    /* Check if port is up */
+    if (__atomic_load_n(&port->info.state, __ATOMIC_RELAXED) != PORT_STATE_UP) {
+        packet_drop_count_burst(pkts, 0, count, PACKET_DROP_PORT_DOWN);
+        return 0;
+    }
+
+    uint32_t timestamp = (uint32_t)sim_clock_time();
+#if CONFIG_ENABLE_PIPELINE_PROFILING
+    uint64_t rx_cycles = packet_profile_now();
+#endif
+    bool rx_csum = (hw_sim_get_port_offloads(port_id) & DRIVER_FLAG_RX_CSUM) != 0;
+    for (uint32_t i = 0; i < count; i++) {
+        packet_buffer_t *packet = pkts[i];
+
+        /* Parse headers once; later stages use the cached offsets */
+        packet_parse(packet);
+
+        /* Offload flags of the sender mean nothing here; the NIC sets its own */
+        if (rx_csum) {
+            packet_offload_rx(packet);
+        } else {
+            packet->metadata.offload = 0;
+        }
+
+        /* Set packet metadata */
+        packet->metadata.port = port_id;
+        packet->metadata.direction = PACKET_DIR_RX;
+        packet->metadata.timestamp = timestamp;
+#if CONFIG_ENABLE_PIPELINE_PROFILING
+        packet->metadata.rx_cycles = rx_cycles;
+#endif
+    }
+    if (int_telemetry_enabled()) {
+        int_telemetry_rx_burst(pkts, count);
+    }
+
+    /* Counted while still ours: once on the ring, a worker may free them */
+    sim_port_counters_t *counters = sim_counters(port_id);
+    uint32_t room = packet_ring_room(port->rx_ring);
+    uint32_t fit = count < room ? count : room;
+    for (uint32_t i = 0; i < fit; i++) {
+        sim_count_rx(counters, pkts[i]);
+    }
+
+    uint32_t queued = packet_ring_enqueue_burst(port->rx_ring, pkts, fit);
+    packet_ring_count_full(port->rx_ring, count - queued);
+    if (queued) {
+        sim_port_notify(port, port_id);
+    }
+
+    if (queued < count) {
+        stats_shard_add(&counters->rx_drops, count - queued);
+        packet_drop_count_burst(pkts, queued, count, PACKET_DROP_RX_RING_FULL);
+        LOG_DEBUG(LOG_CATEGORY_HAL, "RX ring full on port %u, dropped %u packets",
+                  port_id, count - queued);
+    }
+
+    return queued;
+}
+
 /**
  * @brief Simulate packet reception
  *
@@ -233,45 +526,296 @@ status_t hw_sim_receive_packet(port_id_t port_id, packet_buffer_t *packet)
         return STATUS_INVALID_PARAMETER;
     }
     
-    sim_port_t *port = &g_sim_state.ports[port_id];
-    
-    pthread_mutex_lock(&port->lock);
-    
     /* Check if port is up */
-    if (port->info.state != PORT_STATE_UP) {
-        pthread_mutex_unlock(&port->lock);
+    if (__atomic_load_n(&g_sim_state.ports[port_id].info.state, __ATOMIC_RELAXED) != PORT_STATE_UP) {
         return STATUS_FAILURE;
     }
-    
-    /* Update port statistics */
-    port->info.stats.rx_packets++;
-    port->info.stats.rx_bytes += packet->size;
+
+    /* Hand the packet to the forwarding workers */
+    if (hw_sim_rx_enqueue_burst(port_id, &packet, 1) != 1) {
+        return STATUS_RESOURCE_EXHAUSTED;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Take up to max packets from the port RX ring
+ *
+ * @param port_id Ingress port ID
+ * @param pkts Output array for the packets
+ * @param max Maximum number of packets to take
+ * @return Number of packets returned
+ */
+uint32_t hw_sim_rx_dequeue_burst(port_id_t port_id, packet_buffer_t **pkts, uint32_t max)
+{
+    if (!g_sim_state.initialized || port_id >= g_sim_state.port_count || !pkts) {
+        return 0;
+    }
+
+    return packet_ring_dequeue_burst(g_sim_state.ports[port_id].rx_ring, pkts, max);
+}
+
+/**
+ * @brief Move the port RX ring to the NUMA node of the worker draining it
+ *
+ * @param port_id Ingress port ID
+ * @param node NUMA node
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t hw_sim_rx_ring_set_node(port_id_t port_id, uint32_t node)
+{
+    if (!g_sim_state.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (port_id >= g_sim_state.port_count) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    packet_ring_t *ring = g_sim_state.ports[port_id].rx_ring;
+    return sim_numa_bind_memory(ring, packet_ring_bytes(ring->size), node);
+}
+
+/**
+ * @brief Set the notification of the port RX ring
+ *
+ * @param port_id Ingress port ID
+ * @param notify Function to call, NULL to remove
+ * @param user_data Context passed to it
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t hw_sim_rx_ring_set_notify(port_id_t port_id, hw_sim_rx_notify_t notify, void *user_data)
+{
+    if (!g_sim_state.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (port_id >= g_sim_state.port_count) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    sim_port_t *port = &g_sim_state.ports[port_id];
+    __atomic_store_n(&port->rx_notify, NULL, __ATOMIC_RELEASE);
+    __atomic_store_n(&port->rx_notify_data, user_data, __ATOMIC_RELAXED);
+    __atomic_store_n(&port->rx_notify, notify, __ATOMIC_RELEASE);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Run up to budget packets from the port RX ring through the pipeline
+ *
+ * @param port_id Ingress port ID
+ * @param budget Maximum number of packets to process
+ * @return Number of packets processed
+ */
+uint32_t hw_sim_rx_poll(port_id_t port_id, uint32_t budget)
+{
+    packet_buffer_t *pkts[PACKET_BURST_MAX];
+    packet_result_t results[PACKET_BURST_MAX];
+    uint32_t done = 0;
+
+    while (done < budget) {
+        uint32_t want = budget - done < PACKET_BURST_MAX ? budget - done : PACKET_BURST_MAX;
+        uint32_t n = hw_sim_rx_dequeue_burst(port_id, pkts, want);
+        if (n == 0) {
+            break;
+        }
+
+        if (packet_process_burst(pkts, n, results) != STATUS_SUCCESS) {
+            for (uint32_t i = 0; i < n; i++) {
+                results[i] = PACKET_RESULT_DROP;
+            }
+        }
+
+        for (uint32_t i = 0; i < n; i++) {
+            if (results[i] != PACKET_RESULT_CONSUME) {
+                packet_buffer_free(pkts[i]);
+            }
+        }
+        done += n;
+    }
+
+    return done;
+}
+
+/**
+ * @brief TX counters of a burst, added to the port once
+ */
+typedef struct {
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t unicast;
+    uint64_t multicast;
+    uint64_t broadcast;
+    uint64_t drops;
+    uint64_t sizes[SIM_TX_SIZE_BUCKETS];
+} sim_tx_counts_t;
+
+/**
+ * @brief Size bucket of a transmitted frame
+ *
+ * @param length Frame length
+ * @return Index in the order of the tx_packets_* size counters of port_stats_t
+ */
+static inline uint32_t sim_tx_size_bucket(uint32_t length)
+{
+    if (length < 64) {
+        return 0;
+    } else if (length == 64) {
+        return 1;
+    } else if (length <= 127) {
+        return 2;
+    } else if (length <= 255) {
+        return 3;
+    } else if (length <= 511) {
+        return 4;
+    } else if (length <= 1023) {
+        return 5;
+    } else if (length <= 1518) {
+        return 6;
+    }
+    return 7;
+}
+
+/**
+ * @brief Transmit one packet of a burst, counting it in counts
+ */
+static status_t sim_tx_one(sim_port_t *port, packet_buffer_t *packet, port_id_t port_id,
+                           sim_tx_counts_t *counts)
+{
+    /* Egress rewrites drop the header cache; refresh it for the stats */
+    packet_ensure_parsed(packet);
+
+    /* Check packet size against port MTU (chained packets are sent scatter-gather) */
+    uint32_t length = packet_chain_length(packet);
+    if (length > port->info.config.mtu) {
+        counts->drops++;
+        packet->metadata.is_dropped = true;
+        packet_drop_count(packet, PACKET_DROP_MTU_EXCEEDED);
+        LOG_DEBUG(LOG_CATEGORY_HAL, "Dropping packet: size %u exceeds MTU %u on port %u",
+                 length, port->info.config.mtu, port_id);
+        return STATUS_FAILURE;
+    }
+
+    counts->packets++;
+    counts->bytes += length;
+    counts->sizes[sim_tx_size_bucket(length)]++;
 
     /* Determine packet type for stats */
-    if (packet->metadata.dst_mac.addr[0] & 0x01) {
-        if (packet->metadata.dst_mac.addr[0] == 0xFF &&
-            packet->metadata.dst_mac.addr[1] == 0xFF &&
-            packet->metadata.dst_mac.addr[2] == 0xFF &&
-            packet->metadata.dst_mac.addr[3] == 0xFF &&
-            packet->metadata.dst_mac.addr[4] == 0xFF &&
-            packet->metadata.dst_mac.addr[5] == 0xFF) {
-            port->info.stats.rx_broadcast++;
+    if (packet_has_proto(packet, PACKET_PROTO_L2_MCAST | PACKET_PROTO_L2_BCAST)) {
+        if (packet_has_proto(packet, PACKET_PROTO_L2_BCAST)) {
+            counts->broadcast++;
         } else {
-            port->info.stats.rx_multicast++;
+            counts->multicast++;
         }
     } else {
-        port->info.stats.rx_unicast++;
+        counts->unicast++;
     }
-    
-    pthread_mutex_unlock(&port->lock);
-    
-    /* Set packet metadata */
-    packet->metadata.port = port_id;
-    packet->metadata.direction = PACKET_DIR_RX;
-    packet->metadata.timestamp = (uint32_t)time(NULL);
-    
-    /* Inject packet into processing pipeline */
-    return packet_inject(packet);
+
+    LOG_TRACE(LOG_CATEGORY_HAL, "Transmitted packet of size %u on port %u",
+             length, port_id);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Transmit one frame, doing the offload work it left to the NIC first
+ *
+ * A TSO frame leaves as its segments; it counts as sent if all of them were.
+ */
+static status_t sim_tx_frame(sim_port_t *port, packet_buffer_t *packet, port_id_t port_id,
+                             sim_tx_counts_t *counts)
+{
+    packet_buffer_t *segs[PACKET_TSO_MAX_SEGS];
+    uint32_t nsegs = 0;
+
+    if (packet->metadata.offload & PACKET_OFFLOAD_TX_MASK) {
+        status_t status = packet_offload_tx(packet, segs, PACKET_TSO_MAX_SEGS, &nsegs);
+        if (status != STATUS_SUCCESS) {
+            counts->drops++;
+            packet->metadata.is_dropped = true;
+            packet_drop_count(packet, PACKET_DROP_TX_OFFLOAD);
+            LOG_DEBUG(LOG_CATEGORY_HAL, "Dropping packet: offload failed on port %u, error %d",
+                      port_id, status);
+            return status;
+        }
+    }
+    if (nsegs == 0) {
+        return sim_tx_one(port, packet, port_id, counts);
+    }
+
+    status_t result = STATUS_SUCCESS;
+    for (uint32_t i = 0; i < nsegs; i++) {
+        if (sim_tx_one(port, segs[i], port_id, counts) != STATUS_SUCCESS) {
+            result = STATUS_FAILURE;
+        }
+        packet_buffer_free(segs[i]);
+    }
+    return result;
+}
+
+/**
+ * @brief Add the counters of a burst to the port
+ */
+static void sim_tx_count(port_id_t port_id, const sim_tx_counts_t *counts)
+{
+    sim_port_counters_t *counters = sim_counters(port_id);
+
+    if (counts->packets) {
+        stats_shard_add(&counters->tx_packets, counts->packets);
+        stats_shard_add(&counters->tx_bytes, counts->bytes);
+        for (uint32_t i = 0; i < SIM_TX_SIZE_BUCKETS; i++) {
+            if (counts->sizes[i]) {
+                stats_shard_add(&counters->tx_sizes[i], counts->sizes[i]);
+            }
+        }
+    }
+    if (counts->unicast) {
+        stats_shard_add(&counters->tx_unicast, counts->unicast);
+    }
+    if (counts->multicast) {
+        stats_shard_add(&counters->tx_multicast, counts->multicast);
+    }
+    if (counts->broadcast) {
+        stats_shard_add(&counters->tx_broadcast, counts->broadcast);
+    }
+    if (counts->drops) {
+        stats_shard_add(&counters->tx_drops, counts->drops);
+    }
+}
+
+/**
+ * @brief Fold the sharded counters of a port into its statistics
+ *
+ * @param port_id Port identifier
+ * @param[in,out] stats Statistics, the sharded fields are overwritten
+ */
+static void sim_fold_counters(port_id_t port_id, port_stats_t *stats)
+{
+    sim_port_counters_t c;
+
+    stats_shard_fold(g_sim_state.counters, port_id * SIM_PORT_COUNTER_WORDS,
+                     SIM_PORT_COUNTER_WORDS, (uint64_t *)&c);
+    stats->rx_packets = c.rx_packets;
+    stats->rx_bytes = c.rx_bytes;
+    stats->rx_unicast = c.rx_unicast;
+    stats->rx_multicast = c.rx_multicast;
+    stats->rx_broadcast = c.rx_broadcast;
+    stats->rx_drops = c.rx_drops;
+    stats->tx_packets = c.tx_packets;
+    stats->tx_bytes = c.tx_bytes;
+    stats->tx_unicast = c.tx_unicast;
+    stats->tx_multicast = c.tx_multicast;
+    stats->tx_broadcast = c.tx_broadcast;
+    stats->tx_drops = c.tx_drops;
+    stats->tx_packets_lt_64 = c.tx_sizes[0];
+    stats->tx_packets_64 = c.tx_sizes[1];
+    stats->tx_packets_65_127 = c.tx_sizes[2];
+    stats->tx_packets_128_255 = c.tx_sizes[3];
+    stats->tx_packets_256_511 = c.tx_sizes[4];
+    stats->tx_packets_512_1023 = c.tx_sizes[5];
+    stats->tx_packets_1024_1518 = c.tx_sizes[6];
+    stats->tx_packets_1519_max = c.tx_sizes[7];
 }
 
 /**
@@ -293,54 +837,305 @@ status_t hw_sim_transmit_packet(packet_buffer_t *packet, port_id_t port_id)
     
     sim_port_t *port = &g_sim_state.ports[port_id];
 
-    pthread_mutex_lock(&port->lock);
-    
     /* Check if port is up */
-    if (port->info.state != PORT_STATE_UP) {
-        pthread_mutex_unlock(&port->lock);
+    if (__atomic_load_n(&port->info.state, __ATOMIC_RELAXED) != PORT_STATE_UP) {
         packet->metadata.is_dropped = true;
+        packet_drop_count(packet, PACKET_DROP_PORT_DOWN);
         LOG_DEBUG(LOG_CATEGORY_HAL, "Dropping packet: port %u is down", port_id);
         return STATUS_FAILURE;
     }
-    
-    /* Check packet size against port MTU */
-    if (packet->size > port->info.config.mtu) {
-        port->info.stats.tx_drops++;
-        pthread_mutex_unlock(&port->lock);
-        packet->metadata.is_dropped = true;
-        LOG_DEBUG(LOG_CATEGORY_HAL, "Dropping packet: size %u exceeds MTU %u on port %u",
-                 packet->size, port->info.config.mtu, port_id);
-        return STATUS_FAILURE;
+
+    sim_tx_counts_t counts = {0};
+    status_t status = sim_tx_frame(port, packet, port_id, &counts);
+    sim_tx_count(port_id, &counts);
+    return status;
+}
+
+/**
+ * @brief Simulate transmission of a burst of packets
+ *
+ * @param port_id Egress port ID
+ * @param pkts Packets to transmit
+ * @param count Number of packets
+ * @return Number of packets sent; the others were dropped
+ */
+uint32_t hw_sim_transmit_burst(port_id_t port_id, packet_buffer_t **pkts, uint32_t count)
+{
+    if (!g_sim_state.initialized || port_id >= g_sim_state.port_count || !pkts) {
+        return 0;
     }
-    
-    /* Update port statistics */
-    port->info.stats.tx_packets++;
-    port->info.stats.tx_bytes += packet->size;
 
-    /* Determine packet type for stats */
-    if (packet->metadata.dst_mac.addr[0] & 0x01) {
-        if (packet->metadata.dst_mac.addr[0] == 0xFF &&
-            packet->metadata.dst_mac.addr[1] == 0xFF &&
-            packet->metadata.dst_mac.addr[2] == 0xFF &&
-            packet->metadata.dst_mac.addr[3] == 0xFF &&
-            packet->metadata.dst_mac.addr[4] == 0xFF &&
-            packet->metadata.dst_mac.addr[5] == 0xFF) {
-            port->info.stats.tx_broadcast++;
-        } else {
-            port->info.stats.tx_multicast++;
+    sim_port_t *port = &g_sim_state.ports[port_id];
+
+    /* Check if port is up */
+    if (__atomic_load_n(&port->info.state, __ATOMIC_RELAXED) != PORT_STATE_UP) {
+        for (uint32_t i = 0; i < count; i++) {
+            pkts[i]->metadata.is_dropped = true;
+        }
+        packet_drop_count_burst(pkts, 0, count, PACKET_DROP_PORT_DOWN);
+        LOG_DEBUG(LOG_CATEGORY_HAL, "Dropping %u packets: port %u is down", count, port_id);
+        return 0;
+    }
+
+    sim_tx_counts_t counts = {0};
+    uint32_t sent = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (sim_tx_frame(port, pkts[i], port_id, &counts) == STATUS_SUCCESS) {
+            sent++;
+        }
+    }
+    sim_tx_count(port_id, &counts);
+    return sent;
+}
+
+/**
+ * @brief Queue a burst of packets on the port TX ring
+ *
+ * @param port_id Egress port ID
+ * @param pkts Packets to send
+ * @param count Number of packets
+ * @return Number of packets queued (a prefix of pkts)
+ */
+uint32_t hw_sim_tx_enqueue_burst(port_id_t port_id, packet_buffer_t **pkts, uint32_t count)
+{
+    if (!g_sim_state.initialized || port_id >= g_sim_state.port_count || !pkts) {
+        return 0;
+    }
+
+    sim_port_t *port = &g_sim_state.ports[port_id];
+    uint32_t passed, queued;
+
+    /* The policer counted its drops and moved them behind the rest */
+    passed = policer_egress_burst(port_id, pkts, count);
+    if (passed < count) {
+        stats_shard_add(&sim_counters(port_id)->tx_drops, count - passed);
+    }
+
+    /* Once queued the packets belong to the transmit side */
+    mirror_egress_burst(port_id, pkts, passed);
+
+    /* Ports with QoS enabled hold their traffic in the egress queues */
+    if (qos_enqueue_burst(port_id, pkts, passed, &queued) == STATUS_SUCCESS) {
+        if (queued < passed) {
+            stats_shard_add(&sim_counters(port_id)->tx_drops, passed - queued);
+            packet_drop_count_burst(pkts, queued, passed, PACKET_DROP_QOS_QUEUE);
+            LOG_DEBUG(LOG_CATEGORY_HAL, "Egress queues on port %u dropped %u packets",
+                      port_id, passed - queued);
+        }
+        if (queued) {
+            sim_port_notify(port, port_id);
+        }
+        return queued;
+    }
+
+    /* Any worker may route to the port, and the ring takes one producer */
+    spinlock_acquire(&port->tx_lock);
+    queued = packet_ring_enqueue_burst(port->tx_ring, pkts, passed);
+    spinlock_release(&port->tx_lock);
+    if (queued) {
+        sim_port_notify(port, port_id);
+    }
+    if (queued < passed) {
+        stats_shard_add(&sim_counters(port_id)->tx_drops, passed - queued);
+        packet_drop_count_burst(pkts, queued, passed, PACKET_DROP_TX_RING_FULL);
+        LOG_DEBUG(LOG_CATEGORY_HAL, "TX ring full on port %u, dropped %u packets",
+                  port_id, passed - queued);
+    }
+
+    return queued;
+}
+
+/**
+ * @brief Send up to budget packets from the port TX ring
+ *
+ * @param port_id Egress port ID
+ * @param budget Maximum number of packets to send
+ * @return Number of packets taken from the ring
+ */
+uint32_t hw_sim_tx_drain(port_id_t port_id, uint32_t budget)
+{
+    if (!g_sim_state.initialized || port_id >= g_sim_state.port_count) {
+        return 0;
+    }
+
+    packet_buffer_t *pkts[PACKET_BURST_MAX];
+    packet_ring_t *ring = g_sim_state.ports[port_id].tx_ring;
+    bool timed = sim_timing_enabled();
+    uint32_t done = 0;
+
+    while (done < budget) {
+        uint32_t want = budget - done < PACKET_BURST_MAX ? budget - done : PACKET_BURST_MAX;
+        if (timed) {
+            /* A busy port or a full calendar leaves the packets on the ring */
+            uint32_t room = sim_timing_room();
+            if (room == 0 || sim_timing_port_backlogged(port_id)) {
+                break;
+            }
+            if (want > room) {
+                want = room;
+            }
+        }
+        uint32_t n = packet_ring_dequeue_burst(ring, pkts, want);
+        bool queued = n == 0;
+        if (n == 0) {
+            /* Whatever reached the ring before QoS was enabled goes first */
+            n = qos_dequeue_burst(port_id, pkts, want);
+        }
+        if (n == 0) {
+            break;
+        }
+
+        /* Watched packets get this hop's record; the ring counts as queue 0 */
+        if (int_telemetry_enabled()) {
+            if (!queued) {
+                uint32_t depth = packet_ring_count(ring);
+                for (uint32_t i = 0; i < n; i++) {
+                    int_telemetry_note_queue(pkts[i], 0, depth + n - 1 - i);
+                }
+            }
+            int_telemetry_egress_burst(port_id, g_sim_state.ports[port_id].info.config.mtu, pkts, n);
+        }
+
+#if CONFIG_ENABLE_PIPELINE_PROFILING
+        /* Time since the RX ring, for packets that came through one */
+        uint64_t now = packet_profile_now();
+        for (uint32_t i = 0; i < n; i++) {
+            if (pkts[i]->metadata.rx_cycles) {
+                packet_profile_record(PACKET_PROFILE_RESIDENCY, now - pkts[i]->metadata.rx_cycles, 1);
+            }
+        }
+#endif
+
+        /* Modeled packets leave from the release thread at their departure time */
+        uint32_t sent = 0;
+        if (timed) {
+            sent = sim_timing_submit(port_id, g_sim_state.ports[port_id].info.config.speed, pkts, n);
+        }
+        if (sent < n) {
+            sim_tx_send(port_id, pkts + sent, n - sent);
+        }
+        done += n;
+    }
+
+    return done;
+}
+
+/**
+ * @brief Send a burst that has left the port's TX side, and free it
+ *
+ * @param port_id Egress port ID
+ * @param pkts Packets to send
+ * @param count Number of packets (at most PACKET_BURST_MAX)
+ */
+static void sim_tx_send(port_id_t port_id, packet_buffer_t **pkts, uint32_t count)
+{
+    /* The burst leaves through the port's driver if it has one, counted once */
+    driver_handle_t driver = g_sim_state.ports[port_id].info.config.driver;
+    if (driver && driver->ops && driver->ops->transmit_burst) {
+        /* Work the driver does not offload is done here; what it cannot take, it does not get */
+        packet_buffer_t *ready[PACKET_BURST_MAX];
+        uint32_t nready = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            if (packet_offload_resolve(pkts[i], driver->flags) == STATUS_SUCCESS) {
+                ready[nready++] = pkts[i];
+            } else {
+                pkts[i]->metadata.is_dropped = true;
+                packet_drop_count(pkts[i], PACKET_DROP_TX_OFFLOAD);
+            }
+        }
+        if (nready) {
+            driver_transmit_burst(driver, ready, (uint16_t)nready);
         }
     } else {
-        port->info.stats.tx_unicast++;
+        hw_sim_transmit_burst(port_id, pkts, count);
     }
-    
+    for (uint32_t i = 0; i < count; i++) {
+        packet_buffer_free(pkts[i]);
+    }
+}
+
+/**
+ * @brief Get ring counters of a port
+ *
+ * @param port_id Port identifier
+ * @param[out] stats Ring counters
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_sim_get_ring_stats(port_id_t port_id, hw_sim_ring_stats_t *stats)
+{
+    if (!g_sim_state.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (port_id >= g_sim_state.port_count || !stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    const packet_ring_t *rx = g_sim_state.ports[port_id].rx_ring;
+    const packet_ring_t *tx = g_sim_state.ports[port_id].tx_ring;
+
+    stats->rx_enqueued = __atomic_load_n(&rx->enqueued, __ATOMIC_RELAXED);
+    stats->rx_dequeued = __atomic_load_n(&rx->dequeued, __ATOMIC_RELAXED);
+    stats->rx_ring_full = __atomic_load_n(&rx->full_drops, __ATOMIC_RELAXED);
+    stats->tx_enqueued = __atomic_load_n(&tx->enqueued, __ATOMIC_RELAXED);
+    stats->tx_dequeued = __atomic_load_n(&tx->dequeued, __ATOMIC_RELAXED);
+    stats->tx_ring_full = __atomic_load_n(&tx->full_drops, __ATOMIC_RELAXED);
+    stats->rx_occupancy = packet_ring_count(rx);
+    stats->tx_occupancy = packet_ring_count(tx);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Set the offloads of a port's emulated NIC
+ *
+ * @param port_id Port identifier
+ * @param offloads DRIVER_FLAG_TX_CSUM, DRIVER_FLAG_TSO and DRIVER_FLAG_RX_CSUM
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t hw_sim_set_port_offloads(port_id_t port_id, uint32_t offloads)
+{
+    if (!g_sim_state.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (port_id >= g_sim_state.port_count || (offloads & ~DRIVER_FLAGS_OFFLOAD)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    sim_port_t *port = &g_sim_state.ports[port_id];
+    pthread_mutex_lock(&port->lock);
+    __atomic_store_n(&port->offloads, offloads, __ATOMIC_RELAXED);
+    port_fast_path_update(port_id, &port->info, offloads);
     pthread_mutex_unlock(&port->lock);
-    
-    LOG_TRACE(LOG_CATEGORY_HAL, "Transmitted packet of size %u on port %u",
-             packet->size, port_id);
-    
+    LOG_INFO(LOG_CATEGORY_HAL, "Port %u offloads: tx-csum %s, tso %s, rx-csum %s", port_id,
+             (offloads & DRIVER_FLAG_TX_CSUM) ? "on" : "off",
+             (offloads & DRIVER_FLAG_TSO) ? "on" : "off",
+             (offloads & DRIVER_FLAG_RX_CSUM) ? "on" : "off");
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Get the offloads a port advertises
+ *
+ * @param port_id Port identifier
+ * @return Offload flags of the port's driver, or of its emulated NIC when
+ *         it has none; 0 for an invalid port
+ */
+uint32_t hw_sim_get_port_offloads(port_id_t port_id)
+{
+    if (!g_sim_state.initialized || port_id >= g_sim_state.port_count) {
+        return 0;
+    }
+
+    sim_port_t *port = &g_sim_state.ports[port_id];
+    driver_handle_t driver = __atomic_load_n(&port->info.config.driver, __ATOMIC_RELAXED);
+    if (driver) {
+        return driver->flags & DRIVER_FLAGS_OFFLOAD;
+    }
+    return __atomic_load_n(&port->offloads, __ATOMIC_RELAXED);
+}
+
 /**
  * @brief Get the number of ports in hardware
  *
@@ -382,6 +1177,13 @@ status_t hw_sim_clear_port_stats(port_id_t port_id)
 
     /* Clear all statistics counters */
     memset(&port->info.stats, 0, sizeof(port_stats_t));
+    stats_shard_clear(g_sim_state.counters, port_id * SIM_PORT_COUNTER_WORDS, SIM_PORT_COUNTER_WORDS);
+    port->rx_ring->enqueued = 0;
+    port->rx_ring->full_drops = 0;
+    port->rx_ring->dequeued = 0;
+    port->tx_ring->enqueued = 0;
+    port->tx_ring->full_drops = 0;
+    port->tx_ring->dequeued = 0;
 
     pthread_mutex_unlock(&port->lock);
     
@@ -390,6 +1192,37 @@ status_t hw_sim_clear_port_stats(port_id_t port_id)
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Register the subscriber for port link state changes
+ *
+ * @param callback Function to call, NULL to unregister
+ * @param user_data Context passed to the callback
+ * @return status_t STATUS_SUCCESS
+ */
+status_t hw_sim_register_link_callback(hw_sim_link_callback_t callback, void *user_data)
+{
+    /* Context first, so a callback seen by sim_update_port_state() finds its own */
+    __atomic_store_n(&g_sim_state.link_callback, NULL, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_sim_state.link_user_data, user_data, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_sim_state.link_callback, callback, __ATOMIC_RELEASE);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Set the observer of received packets
+ *
+ * @param tap Function to call, NULL to remove
+ * @param user_data Context passed to the tap
+ * @return status_t STATUS_SUCCESS
+ */
+status_t hw_sim_set_rx_tap(hw_sim_rx_tap_t tap, void *user_data)
+{
+    __atomic_store_n(&g_sim_state.rx_tap, NULL, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_sim_state.rx_tap_user_data, user_data, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_sim_state.rx_tap, tap, __ATOMIC_RELEASE);
+    return STATUS_SUCCESS;
+}
+
 /* Private function implementation */
 
 /**
@@ -410,6 +1243,19 @@ static status_t sim_init_port(port_id_t port_id)
     if (pthread_mutex_init(&port->lock, NULL) != 0) {
         return STATUS_FAILURE;
     }
+
+    /* Allocate packet rings */
+    spinlock_init(&port->tx_lock);
+    port->rx_ring = packet_ring_create(CONFIG_RING_BUFFER_SIZE);
+    port->tx_ring = packet_ring_create(CONFIG_RING_BUFFER_SIZE);
+    if (!port->rx_ring || !port->tx_ring) {
+        packet_ring_destroy(port->rx_ring);
+        packet_ring_destroy(port->tx_ring);
+        port->rx_ring = NULL;
+        port->tx_ring = NULL;
+        pthread_mutex_destroy(&port->lock);
+        return STATUS_NO_MEMORY;
+    }
     
     /* Initialize port data */
     memset(&port->info, 0, sizeof(port_info_t));
@@ -454,6 +1300,7 @@ static status_t sim_init_port(port_id_t port_id)
 static void sim_update_port_state(port_id_t port_id)
 {
     sim_port_t *port = &g_sim_state.ports[port_id];
+    port_state_t old_state = port->info.state;
 
     /* Port lock must be held by caller */
 
@@ -471,6 +1318,19 @@ static void sim_update_port_state(port_id_t port_id)
         port->info.state = PORT_STATE_DOWN;
         LOG_INFO(LOG_CATEGORY_HAL, "Port %u link is DOWN (administratively disabled)", port_id);
     }
+
+    __atomic_add_fetch(&port->version, 1, __ATOMIC_RELEASE);
+    port_fast_path_update(port_id, &port->info, __atomic_load_n(&port->offloads, __ATOMIC_RELAXED));
+
+    if (port->info.state != old_state) {
+        hw_sim_link_callback_t callback = __atomic_load_n(&g_sim_state.link_callback, __ATOMIC_ACQUIRE);
+        if (event_feed_enabled(EVENT_FEED_LINK)) {
+            event_feed_post_link(port_id, (uint8_t)port->info.state);
+        }
+        if (callback != NULL) {
+            callback(port_id, port->info.state, __atomic_load_n(&g_sim_state.link_user_data, __ATOMIC_RELAXED));
+        }
+    }
 }
 
 
@@ -0,0 +1,718 @@
+/**
+ * @file int_telemetry.c
+ * @brief Implementation of in-band network telemetry stamping
+ *
+ * Stamping opens room in the headers the way a VLAN push does: the
+ * bytes are taken from the headroom and everything in front of the
+ * insertion point is moved forward, so the payload stays where it is and
+ * the header cache stays valid. Checksums are patched with the one's
+ * complement sum of the bytes inserted or removed and of the 16-bit words
+ * that changed (RFC 1624); the shim and its records start an even number
+ * of bytes into the transport header, so they line up with its words.
+ *
+ * Sink statistics are kept in a fixed open-addressing table of cache-line
+ * slots claimed by compare-and-swap and updated with atomics, so sink
+ * ports on different threads never wait for one another.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/config.h"
+#include "common/logging.h"
+#include "common/threading.h"
+#include "common/bitmap.h"
+#include "common/mem_account.h"
+#include "common/stats_shard.h"
+#include "hal/packet.h"
+#include "hal/packet_offload.h"
+#include "hal/int_telemetry.h"
+
+#define INT_NS_PER_SEC          1000000000ULL
+#define INT_IPV4_TOS_OFF        1
+#define INT_IPV4_LEN_OFF        2
+#define INT_IPV4_CSUM_OFF       10
+#define INT_UDP_LEN_OFF         4
+#define INT_UDP_CSUM_OFF        6
+#define INT_TCP_CSUM_OFF        16
+#define INT_DEPTH_MAX           0xFFFFFFu
+
+/**
+ * @brief Counters, by index in the stats_shard block; int_telemetry_stats_t order
+ */
+enum {
+    INT_CTR_SOURCED = 0,
+    INT_CTR_STAMPED,
+    INT_CTR_SUNK,
+    INT_CTR_RECORDS,
+    INT_CTR_EXCEEDED,
+    INT_CTR_MTU_SKIPPED,
+    INT_CTR_UNSUPPORTED,
+    INT_CTR_UNTRACKED,
+    INT_CTR_COUNT
+};
+
+/**
+ * @brief Statistics of one hop at the sink
+ */
+typedef struct __attribute__((aligned(64))) {
+    uint64_t key;                   /**< (switch ID << 16 | egress port) + 1, 0 while free */
+    uint64_t packets;
+    uint64_t latency_total_ns;
+    uint64_t latency_max_ns;
+    uint64_t depth_total;
+    uint64_t depth_max;
+} int_hop_slot_t;
+
+/**
+ * @brief Headers of a packet that can be stamped, offsets into its first segment
+ */
+typedef struct {
+    uint32_t l3;                    /**< IPv4 header */
+    uint32_t l4;                    /**< TCP or UDP header */
+    uint32_t end;                   /**< End of the transport header, where the shim goes */
+    bool udp;
+} int_frame_t;
+
+#if CONFIG_ENABLE_INT
+bool g_int_enabled = false;
+#endif
+
+/**
+ * @brief INT module state
+ */
+static struct {
+    bool initialized;
+    spinlock_t lock;                /**< Serializes configuration */
+    uint32_t switch_id;
+    uint8_t max_hops;
+    uint64_t sinks[BITMAP_WORDS(CONFIG_MAX_PORTS)];
+    stats_shard_set_t *counters;    /**< INT_CTR_COUNT counters */
+    int_hop_slot_t *slots;          /**< CONFIG_INT_SINK_SLOTS hops */
+} g_int = {0};
+
+static inline uint64_t int_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * INT_NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint16_t int_read16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline void int_write16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static inline uint32_t int_read32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void int_write32(uint8_t *p, uint32_t v) {
+    int_write16(p, (uint16_t)(v >> 16));
+    int_write16(p + 2, (uint16_t)v);
+}
+
+/**
+ * @brief Add the change of a 16-bit word to a checksum delta
+ */
+static inline uint32_t int_csum_word(uint32_t delta, uint16_t old, uint16_t now) {
+    return delta + (uint16_t)~old + now;
+}
+
+/**
+ * @brief Patch a checksum field by a one's complement delta
+ *
+ * @param field Checksum in the header
+ * @param delta Sum to add to what the checksum covers
+ * @param udp Zero means no checksum, and a result of zero is sent as all ones
+ */
+static void int_csum_patch(uint8_t *field, uint32_t delta, bool udp) {
+    uint16_t old = int_read16(field);
+    uint16_t value;
+
+    if (udp && old == 0) {
+        return;
+    }
+    value = packet_csum_fold((uint32_t)(uint16_t)~old + delta);
+    if (udp && value == 0) {
+        value = 0xFFFF;
+    }
+    int_write16(field, value);
+}
+
+/**
+ * @brief Find the headers of a packet that can be stamped
+ *
+ * @return true for an unfragmented IPv4 TCP or UDP packet whose headers
+ *         are in the first segment and that is not a TSO frame
+ */
+static bool int_frame_get(packet_buffer_t *packet, int_frame_t *frame) {
+    const packet_metadata_t *md = &packet->metadata;
+    const uint8_t *data = packet->data;
+    uint32_t hdr_len;
+
+    if (packet_ensure_parsed(packet) != STATUS_SUCCESS ||
+        !packet_parsed_has(packet, PACKET_PARSED_L3 | PACKET_PARSED_L4) ||
+        !packet_has_proto(packet, PACKET_PROTO_IPV4) ||
+        !packet_has_proto(packet, PACKET_PROTO_TCP | PACKET_PROTO_UDP) ||
+        packet_has_proto(packet, PACKET_PROTO_IP_FRAG) ||
+        (md->offload & PACKET_OFFLOAD_TSO)) {
+        return false;
+    }
+
+    frame->l3 = md->l3_offset;
+    frame->l4 = md->l4_offset;
+    frame->udp = packet_has_proto(packet, PACKET_PROTO_UDP);
+    if (frame->udp) {
+        hdr_len = 8;
+    } else {
+        if (frame->l4 + 13 > packet->size) {
+            return false;
+        }
+        hdr_len = (uint32_t)(data[frame->l4 + 12] >> 4) * 4;
+    }
+    frame->end = frame->l4 + hdr_len;
+
+    return hdr_len >= 8 && frame->end <= packet->size &&
+           frame->l3 + int_read16(data + frame->l3 + INT_IPV4_LEN_OFF) >= frame->end;
+}
+
+/**
+ * @brief Check for a shim at the end of the transport header
+ *
+ * @return Its length in bytes, 0 if there is none
+ */
+static uint32_t int_shim_len(const packet_buffer_t *packet, const int_frame_t *frame) {
+    const uint8_t *ip = packet->data + frame->l3;
+    const uint8_t *shim = packet->data + frame->end;
+    uint32_t len;
+
+    if (!(ip[INT_IPV4_TOS_OFF] & (INT_DSCP_MARK << 2)) ||
+        frame->end + INT_SHIM_LEN > packet->size || shim[0] >> 4 != INT_VERSION) {
+        return 0;
+    }
+    len = int_read16(shim + 4);
+    if (len != INT_SHIM_LEN + (uint32_t)shim[1] * INT_HOP_LEN || frame->end + len > packet->size ||
+        frame->l3 + int_read16(ip + INT_IPV4_LEN_OFF) < frame->end + len) {
+        return 0;
+    }
+    return len;
+}
+
+/**
+ * @brief Give a packet private data, keeping its header cache
+ */
+static bool int_make_writable(packet_buffer_t *packet) {
+    uint16_t parsed = packet->metadata.parsed;
+
+    if (packet_make_writable(packet) != STATUS_SUCCESS) {
+        return false;
+    }
+    packet->metadata.parsed = parsed;
+    return true;
+}
+
+/**
+ * @brief Open room inside the headers
+ *
+ * @param packet Packet
+ * @param offset Where the room goes; the bytes in front of it move forward
+ * @param len Bytes of room
+ * @return Start of the room, NULL if the packet could not grow
+ */
+static uint8_t *int_insert(packet_buffer_t *packet, uint32_t offset, uint32_t len) {
+    uint16_t parsed = packet->metadata.parsed;
+    uint8_t *frame;
+
+    if (packet_push_header(packet, len, &frame) != STATUS_SUCCESS) {
+        return NULL;
+    }
+    packet->metadata.parsed = parsed;
+    memmove(frame, frame + len, offset);
+    return frame + offset;
+}
+
+/**
+ * @brief Take bytes out of the headers; the packet must be writable
+ *
+ * @param packet Packet
+ * @param offset Start of the bytes
+ * @param len Number of bytes
+ */
+static void int_remove(packet_buffer_t *packet, uint32_t offset, uint32_t len) {
+    uint16_t parsed = packet->metadata.parsed;
+
+    memmove(packet->data + len, packet->data, offset);
+    packet_pull_header(packet, len, NULL);
+    packet->metadata.parsed = parsed;
+}
+
+/**
+ * @brief Headers as they were before a change, for int_fixup()
+ */
+typedef struct {
+    uint16_t ip_word0;              /**< Version, header length and TOS */
+    uint16_t ip_len;
+    uint16_t udp_len;
+} int_saved_t;
+
+static void int_save(const packet_buffer_t *packet, const int_frame_t *frame, int_saved_t *saved) {
+    const uint8_t *ip = packet->data + frame->l3;
+
+    saved->ip_word0 = int_read16(ip);
+    saved->ip_len = int_read16(ip + INT_IPV4_LEN_OFF);
+    saved->udp_len = frame->udp ? int_read16(packet->data + frame->l4 + INT_UDP_LEN_OFF) : 0;
+}
+
+/**
+ * @brief Grow or shrink the length fields and patch the checksums
+ *
+ * @param packet Packet, already changed
+ * @param frame Its headers
+ * @param saved The headers before the change
+ * @param grow Bytes added to the transport payload, negative if removed
+ * @param l4_delta Sum of the bytes added and the word changes in the transport part
+ */
+static void int_fixup(packet_buffer_t *packet, const int_frame_t *frame, const int_saved_t *saved,
+                      int32_t grow, uint32_t l4_delta) {
+    uint8_t *ip = packet->data + frame->l3;
+    uint8_t *l4 = packet->data + frame->l4;
+    uint16_t ip_len = (uint16_t)(saved->ip_len + grow);
+    uint16_t l4_len = (uint16_t)(ip_len - (frame->l4 - frame->l3));
+    uint32_t ip_delta = 0;
+
+    int_write16(ip + INT_IPV4_LEN_OFF, ip_len);
+    ip_delta = int_csum_word(ip_delta, saved->ip_word0, int_read16(ip));
+    ip_delta = int_csum_word(ip_delta, saved->ip_len, ip_len);
+    if (!(packet->metadata.offload & PACKET_OFFLOAD_IP_CSUM)) {
+        int_csum_patch(ip + INT_IPV4_CSUM_OFF, ip_delta, false);
+    }
+
+    // The pseudo-header carries the transport length, UDP its own copy too
+    l4_delta = int_csum_word(l4_delta, (uint16_t)(saved->ip_len - (frame->l4 - frame->l3)), l4_len);
+    if (frame->udp) {
+        uint16_t udp_len = (uint16_t)(saved->udp_len + grow);
+
+        int_write16(l4 + INT_UDP_LEN_OFF, udp_len);
+        l4_delta = int_csum_word(l4_delta, saved->udp_len, udp_len);
+    }
+    if (!(packet->metadata.offload & PACKET_OFFLOAD_L4_CSUM)) {
+        int_csum_patch(l4 + (frame->udp ? INT_UDP_CSUM_OFF : INT_TCP_CSUM_OFF), l4_delta, frame->udp);
+    }
+}
+
+/**
+ * @brief Slot of a hop, claimed if it is new
+ *
+ * @return Slot, NULL if the table is full
+ */
+static int_hop_slot_t *int_slot_get(uint32_t switch_id, uint16_t port) {
+    uint64_t key = ((uint64_t)switch_id << 16 | port) + 1;
+    uint32_t i = (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) % CONFIG_INT_SINK_SLOTS;
+
+    for (uint32_t n = 0; n < CONFIG_INT_SINK_SLOTS; n++) {
+        int_hop_slot_t *slot = &g_int.slots[i];
+        uint64_t seen = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE);
+
+        if (seen == 0 && __atomic_compare_exchange_n(&slot->key, &seen, key, false,
+                                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return slot;
+        }
+        if (seen == key) {
+            return slot;
+        }
+        if (++i == CONFIG_INT_SINK_SLOTS) {
+            i = 0;
+        }
+    }
+    return NULL;
+}
+
+static inline void int_atomic_max(uint64_t *max, uint64_t value) {
+    uint64_t old = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+    while (value > old && !__atomic_compare_exchange_n(max, &old, value, true,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+ * @brief Feed one hop record to the sink statistics
+ */
+static void int_sink_record(const uint8_t *rec, uint64_t *ctr) {
+    int_hop_slot_t *slot = int_slot_get(int_read32(rec), int_read16(rec + 6));
+    uint64_t latency = int_read32(rec + 8);
+    uint64_t depth = int_read32(rec + 12) & INT_DEPTH_MAX;
+
+    if (!slot) {
+        stats_shard_add(&ctr[INT_CTR_UNTRACKED], 1);
+        return;
+    }
+    __atomic_fetch_add(&slot->packets, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&slot->latency_total_ns, latency, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&slot->depth_total, depth, __ATOMIC_RELAXED);
+    int_atomic_max(&slot->latency_max_ns, latency);
+    int_atomic_max(&slot->depth_max, depth);
+    stats_shard_add(&ctr[INT_CTR_RECORDS], 1);
+}
+
+/**
+ * @brief Build the record of this hop
+ */
+static void int_hop_build(uint8_t *rec, const packet_buffer_t *packet, port_id_t port_id,
+                          uint32_t switch_id, uint64_t now) {
+    const packet_metadata_t *md = &packet->metadata;
+    uint64_t latency = md->int_rx_ns && now > md->int_rx_ns ? now - md->int_rx_ns : 0;
+    uint32_t depth = md->int_depth < INT_DEPTH_MAX ? md->int_depth : INT_DEPTH_MAX;
+
+    int_write32(rec, switch_id);
+    int_write16(rec + 4, md->port);
+    int_write16(rec + 6, port_id);
+    int_write32(rec + 8, latency < UINT32_MAX ? (uint32_t)latency : UINT32_MAX);
+    int_write32(rec + 12, (uint32_t)md->int_queue << 24 | depth);
+}
+
+/**
+ * @brief Put the shim and this hop's record into a packet of a watched flow
+ */
+static void int_source(packet_buffer_t *packet, const int_frame_t *frame, const uint8_t *hop,
+                       uint8_t max_hops, uint32_t mtu, uint64_t *ctr) {
+    uint32_t len = INT_SHIM_LEN + INT_HOP_LEN;
+    int_saved_t saved;
+    uint8_t *shim;
+    uint8_t *ip;
+
+    if (packet_chain_length(packet) + len > mtu) {
+        stats_shard_add(&ctr[INT_CTR_MTU_SKIPPED], 1);
+        return;
+    }
+    int_save(packet, frame, &saved);
+    if ((shim = int_insert(packet, frame->end, len)) == NULL) {
+        stats_shard_add(&ctr[INT_CTR_UNSUPPORTED], 1);
+        return;
+    }
+
+    ip = packet->data + frame->l3;
+    shim[0] = INT_VERSION << 4;
+    shim[1] = 1;
+    shim[2] = max_hops;
+    shim[3] = ip[INT_IPV4_TOS_OFF] >> 2;
+    int_write16(shim + 4, (uint16_t)len);
+    int_write16(shim + 6, 0);
+    memcpy(shim + INT_SHIM_LEN, hop, INT_HOP_LEN);
+    ip[INT_IPV4_TOS_OFF] |= INT_DSCP_MARK << 2;
+
+    int_fixup(packet, frame, &saved, (int32_t)len, packet_csum_add(0, shim, len));
+    stats_shard_add(&ctr[INT_CTR_SOURCED], 1);
+}
+
+/**
+ * @brief Add this hop's record to a packet carrying a shim
+ */
+static void int_transit(packet_buffer_t *packet, const int_frame_t *frame, const uint8_t *hop,
+                        uint32_t mtu, uint64_t *ctr) {
+    uint8_t *shim = packet->data + frame->end;
+    uint16_t old0 = int_read16(shim);
+    uint16_t old_len = int_read16(shim + 4);
+    int_saved_t saved;
+    uint32_t delta;
+
+    int_save(packet, frame, &saved);
+    if (shim[1] >= shim[2]) {
+        // No room in the stack: count the hop and flag the packet
+        uint16_t old6 = int_read16(shim + 6);
+
+        if (!int_make_writable(packet)) {
+            stats_shard_add(&ctr[INT_CTR_UNSUPPORTED], 1);
+            return;
+        }
+        shim = packet->data + frame->end;
+        shim[0] |= INT_SHIM_F_EXCEEDED;
+        if (old6 < UINT16_MAX) {
+            int_write16(shim + 6, (uint16_t)(old6 + 1));
+        }
+        delta = int_csum_word(0, old0, int_read16(shim));
+        delta = int_csum_word(delta, old6, int_read16(shim + 6));
+        int_fixup(packet, frame, &saved, 0, delta);
+        stats_shard_add(&ctr[INT_CTR_EXCEEDED], 1);
+        return;
+    }
+    if (packet_chain_length(packet) + INT_HOP_LEN > mtu) {
+        stats_shard_add(&ctr[INT_CTR_MTU_SKIPPED], 1);
+        return;
+    }
+
+    uint8_t *rec = int_insert(packet, frame->end + INT_SHIM_LEN, INT_HOP_LEN);
+    if (!rec) {
+        stats_shard_add(&ctr[INT_CTR_UNSUPPORTED], 1);
+        return;
+    }
+    shim = rec - INT_SHIM_LEN;
+    memcpy(rec, hop, INT_HOP_LEN);
+    shim[1]++;
+    int_write16(shim + 4, (uint16_t)(old_len + INT_HOP_LEN));
+
+    delta = packet_csum_add(0, rec, INT_HOP_LEN);
+    delta = int_csum_word(delta, old0, int_read16(shim));
+    delta = int_csum_word(delta, old_len, int_read16(shim + 4));
+    int_fixup(packet, frame, &saved, INT_HOP_LEN, delta);
+    stats_shard_add(&ctr[INT_CTR_STAMPED], 1);
+}
+
+/**
+ * @brief Feed the records of a packet to the sink statistics and take its shim out
+ */
+static void int_sink(packet_buffer_t *packet, const int_frame_t *frame, uint32_t shim_len,
+                     uint64_t *ctr) {
+    int_saved_t saved;
+    uint8_t *shim;
+    uint8_t *ip;
+    uint8_t dscp;
+
+    if (!int_make_writable(packet)) {
+        stats_shard_add(&ctr[INT_CTR_UNSUPPORTED], 1);
+        return;
+    }
+    shim = packet->data + frame->end;
+    for (uint32_t i = 0; i < shim[1]; i++) {
+        int_sink_record(shim + INT_SHIM_LEN + i * INT_HOP_LEN, ctr);
+    }
+
+    int_save(packet, frame, &saved);
+    dscp = shim[3];
+    uint32_t delta = packet_csum_fold(packet_csum_add(0, shim, shim_len));
+    int_remove(packet, frame->end, shim_len);
+
+    ip = packet->data + frame->l3;
+    ip[INT_IPV4_TOS_OFF] = (uint8_t)(dscp << 2 | (ip[INT_IPV4_TOS_OFF] & 0x03));
+    int_fixup(packet, frame, &saved, -(int32_t)shim_len, delta);
+    stats_shard_add(&ctr[INT_CTR_SUNK], 1);
+}
+
+status_t int_telemetry_init(void) {
+    status_t status;
+
+    if (g_int.initialized) {
+        return STATUS_SUCCESS;
+    }
+
+    spinlock_init(&g_int.lock);
+    status = stats_shard_create(INT_CTR_COUNT, &g_int.counters);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    g_int.slots = mem_aligned_alloc(MEM_TAG_STATS, 64, sizeof(int_hop_slot_t) * CONFIG_INT_SINK_SLOTS);
+    if (!g_int.slots) {
+        stats_shard_destroy(g_int.counters);
+        g_int.counters = NULL;
+        return STATUS_NO_MEMORY;
+    }
+    memset(g_int.slots, 0, sizeof(int_hop_slot_t) * CONFIG_INT_SINK_SLOTS);
+    bitmap_zero(g_int.sinks, BITMAP_WORDS(CONFIG_MAX_PORTS));
+    g_int.switch_id = 0;
+    g_int.max_hops = CONFIG_INT_MAX_HOPS;
+    g_int.initialized = true;
+    return STATUS_SUCCESS;
+}
+
+void int_telemetry_shutdown(void) {
+    if (!g_int.initialized) {
+        return;
+    }
+#if CONFIG_ENABLE_INT
+    __atomic_store_n(&g_int_enabled, false, __ATOMIC_RELEASE);
+#endif
+    g_int.initialized = false;
+    stats_shard_destroy(g_int.counters);
+    mem_free(MEM_TAG_STATS, g_int.slots);
+    g_int.counters = NULL;
+    g_int.slots = NULL;
+}
+
+status_t int_telemetry_configure(const int_telemetry_config_t *config) {
+#if CONFIG_ENABLE_INT
+    if (!g_int.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!config || config->max_hops > CONFIG_INT_MAX_HOPS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_int.lock);
+    __atomic_store_n(&g_int.switch_id, config->switch_id, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_int.max_hops, config->max_hops ? config->max_hops : CONFIG_INT_MAX_HOPS,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&g_int_enabled, config->enabled, __ATOMIC_RELEASE);
+    spinlock_release(&g_int.lock);
+
+    LOG_INFO(LOG_CATEGORY_HAL, "INT %s, switch ID %u", config->enabled ? "enabled" : "disabled",
+             config->switch_id);
+    return STATUS_SUCCESS;
+#else
+    (void)config;
+    return STATUS_NOT_SUPPORTED;
+#endif
+}
+
+status_t int_telemetry_get_config(int_telemetry_config_t *config) {
+    if (!config) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_int.lock);
+    config->enabled = int_telemetry_enabled();
+    config->switch_id = g_int.switch_id;
+    config->max_hops = g_int.max_hops;
+    spinlock_release(&g_int.lock);
+    return STATUS_SUCCESS;
+}
+
+status_t int_telemetry_set_sink(port_id_t port_id, bool sink) {
+    if (!g_int.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (port_id >= CONFIG_MAX_PORTS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_int.lock);
+    bitmap_assign(g_int.sinks, port_id, sink);
+    spinlock_release(&g_int.lock);
+    return STATUS_SUCCESS;
+}
+
+void int_telemetry_rx_burst(packet_buffer_t **pkts, uint32_t count) {
+#if CONFIG_ENABLE_INT
+    uint64_t now = int_now_ns();
+
+    for (uint32_t i = 0; i < count; i++) {
+        packet_buffer_t *packet = pkts[i];
+        packet_metadata_t *md = &packet->metadata;
+        int_frame_t frame;
+
+        md->int_rx_ns = now;
+        md->int_queue = 0;
+        md->int_depth = 0;
+        md->int_watch = INT_WATCH_NONE;
+
+        // Only marked IPv4 packets are looked at any closer
+        if (packet_parsed_has(packet, PACKET_PARSED_L3) && packet_has_proto(packet, PACKET_PROTO_IPV4) &&
+            md->l3_offset + 2u <= packet->size &&
+            (packet->data[md->l3_offset + INT_IPV4_TOS_OFF] & (INT_DSCP_MARK << 2)) &&
+            int_frame_get(packet, &frame) && int_shim_len(packet, &frame)) {
+            md->int_watch = INT_WATCH_TRANSIT;
+        }
+    }
+#else
+    (void)pkts;
+    (void)count;
+#endif
+}
+
+void int_telemetry_egress_burst(port_id_t port_id, uint32_t mtu, packet_buffer_t **pkts, uint32_t count) {
+#if CONFIG_ENABLE_INT
+    uint32_t switch_id = __atomic_load_n(&g_int.switch_id, __ATOMIC_RELAXED);
+    uint8_t max_hops = __atomic_load_n(&g_int.max_hops, __ATOMIC_RELAXED);
+    bool sink = port_id < CONFIG_MAX_PORTS && bitmap_test(g_int.sinks, port_id);
+    uint64_t *ctr = NULL;
+    uint64_t now = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        packet_buffer_t *packet = pkts[i];
+        uint8_t watch = packet->metadata.int_watch;
+        uint8_t hop[INT_HOP_LEN];
+        int_frame_t frame;
+        uint32_t shim_len = 0;
+
+        if (watch == INT_WATCH_NONE) {
+            continue;
+        }
+        if (!ctr) {
+            if ((ctr = stats_shard_local(g_int.counters)) == NULL) {
+                return;
+            }
+            now = int_now_ns();
+        }
+        packet->metadata.int_watch = INT_WATCH_NONE;
+
+        if (!int_frame_get(packet, &frame) ||
+            (watch == INT_WATCH_TRANSIT && (shim_len = int_shim_len(packet, &frame)) == 0)) {
+            stats_shard_add(&ctr[INT_CTR_UNSUPPORTED], 1);
+            continue;
+        }
+        int_hop_build(hop, packet, port_id, switch_id, now);
+
+        if (watch == INT_WATCH_SOURCE) {
+            // First and last hop at once: nothing to carry
+            if (sink) {
+                int_sink_record(hop, ctr);
+            } else {
+                int_source(packet, &frame, hop, max_hops, mtu, ctr);
+            }
+        } else if (sink) {
+            int_sink_record(hop, ctr);
+            int_sink(packet, &frame, shim_len, ctr);
+        } else {
+            int_transit(packet, &frame, hop, mtu, ctr);
+        }
+    }
+#else
+    (void)port_id;
+    (void)mtu;
+    (void)pkts;
+    (void)count;
+#endif
+}
+
+status_t int_telemetry_get_hop(uint32_t slot, int_telemetry_hop_stats_t *stats) {
+    const int_hop_slot_t *s;
+    uint64_t key;
+
+    if (!g_int.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (slot >= CONFIG_INT_SINK_SLOTS || !stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    s = &g_int.slots[slot];
+    if ((key = __atomic_load_n(&s->key, __ATOMIC_ACQUIRE)) == 0) {
+        return STATUS_NOT_FOUND;
+    }
+    key--;
+    stats->switch_id = (uint32_t)(key >> 16);
+    stats->egress_port = (port_id_t)(key & 0xFFFF);
+    stats->packets = __atomic_load_n(&s->packets, __ATOMIC_RELAXED);
+    stats->latency_total_ns = __atomic_load_n(&s->latency_total_ns, __ATOMIC_RELAXED);
+    stats->latency_max_ns = __atomic_load_n(&s->latency_max_ns, __ATOMIC_RELAXED);
+    stats->depth_total = __atomic_load_n(&s->depth_total, __ATOMIC_RELAXED);
+    stats->depth_max = __atomic_load_n(&s->depth_max, __ATOMIC_RELAXED);
+    return STATUS_SUCCESS;
+}
+
+status_t int_telemetry_get_stats(int_telemetry_stats_t *stats) {
+    uint64_t ctr[INT_CTR_COUNT];
+
+    if (!g_int.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    stats_shard_fold(g_int.counters, 0, INT_CTR_COUNT, ctr);
+    stats->sourced = ctr[INT_CTR_SOURCED];
+    stats->stamped = ctr[INT_CTR_STAMPED];
+    stats->sunk = ctr[INT_CTR_SUNK];
+    stats->records = ctr[INT_CTR_RECORDS];
+    stats->exceeded = ctr[INT_CTR_EXCEEDED];
+    stats->mtu_skipped = ctr[INT_CTR_MTU_SKIPPED];
+    stats->unsupported = ctr[INT_CTR_UNSUPPORTED];
+    stats->untracked = ctr[INT_CTR_UNTRACKED];
+    return STATUS_SUCCESS;
+}
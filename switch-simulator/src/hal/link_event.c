@@ -0,0 +1,521 @@
+/**
+ * @file link_event.c
+ * @brief Implementation of coalesced and dampened port link events
+ *
+ * Reports only mark the port in a pending bitmap and arm the one-shot
+ * coalescing timer if it is not armed yet. When the timer fires the
+ * pending ports are compared with what subscribers were last told, and
+ * only those whose effective state (link up and not suppressed) differs
+ * make it into the batch. Penalties are decayed lazily, from the time of
+ * the last update, whenever a port is looked at; a periodic reuse timer
+ * runs only while some port is suppressed.
+ *
+ * Deliveries are serialized so subscribers see batches in order, and run
+ * without the state lock so they may query link events or block.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/config.h"
+#include "common/logging.h"
+#include "common/event_loop.h"
+#include "common/bitmap.h"
+#include "hal/link_event.h"
+
+/* Interval of reuse checks while a port is suppressed */
+#define LINK_EVENT_REUSE_CHECK_MS 500
+
+/**
+ * @brief Link event state of a port
+ */
+typedef struct {
+    bool link_up;                   /**< Last reported */
+    bool delivered_up;              /**< Last delivered */
+    bool suppressed;
+    double penalty;                 /**< As of penalty_us */
+    uint64_t penalty_us;
+    uint64_t flaps;
+} link_port_state_t;
+
+/**
+ * @brief Subscriber slot
+ */
+typedef struct {
+    link_event_cb_t cb;
+    void *arg;
+} link_subscriber_t;
+
+static struct {
+    bool initialized;
+    link_event_config_t config;
+    double penalty_ceiling;         /**< Decays to the reuse threshold in max_suppress_ms */
+    link_port_state_t ports[CONFIG_MAX_PORTS];
+    uint64_t pending[LINK_EVENT_PORT_WORDS];
+    uint32_t suppressed_count;
+    bool coalesce_armed;
+    bool reuse_armed;
+    event_timer_t coalesce_timer;
+    event_timer_t reuse_timer;
+    link_event_stats_t stats;
+} g_link;
+
+/* State lock; taken before the event loop lock when arming timers */
+static pthread_mutex_t g_link_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Serializes deliveries */
+static pthread_mutex_t g_deliver_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Subscribers outlive init and shutdown */
+static pthread_mutex_t g_sub_lock = PTHREAD_MUTEX_INITIALIZER;
+static link_subscriber_t g_subscribers[LINK_EVENT_MAX_SUBSCRIBERS];
+static uint32_t g_subscriber_count;
+
+void link_event_get_default_config(link_event_config_t *config) {
+    if (!config) {
+        return;
+    }
+
+    memset(config, 0, sizeof(*config));
+    config->coalesce_ms = 10;
+    config->dampening.enabled = false;
+    config->dampening.penalty = 1000;
+    config->dampening.suppress_threshold = 2000;
+    config->dampening.reuse_threshold = 750;
+    config->dampening.half_life_ms = 15000;
+    config->dampening.max_suppress_ms = 60000;
+}
+
+/**
+ * @brief Check dampening parameters; disabled dampening is not checked
+ */
+static bool link_config_valid(const link_event_config_t *config) {
+    const link_dampening_config_t *d = &config->dampening;
+
+    if (!d->enabled) {
+        return true;
+    }
+
+    return d->penalty > 0 && d->half_life_ms > 0 && d->reuse_threshold > 0 &&
+           d->suppress_threshold > d->reuse_threshold &&
+           d->max_suppress_ms >= d->half_life_ms / 2;
+}
+
+/**
+ * @brief Apply parameters, with the state lock held
+ */
+static void link_apply_config(const link_event_config_t *config) {
+    const link_dampening_config_t *d = &config->dampening;
+
+    g_link.config = *config;
+    g_link.penalty_ceiling = 0;
+    if (d->enabled) {
+        g_link.penalty_ceiling = d->reuse_threshold *
+                                 exp2((double)d->max_suppress_ms / d->half_life_ms);
+    }
+}
+
+/**
+ * @brief Decay a port's penalty up to now
+ */
+static void link_decay(link_port_state_t *st, uint64_t now_us) {
+    if (st->penalty <= 0 || now_us <= st->penalty_us) {
+        st->penalty_us = now_us > st->penalty_us ? now_us : st->penalty_us;
+        return;
+    }
+
+    double half_life_us = g_link.config.dampening.half_life_ms * 1000.0;
+    st->penalty *= exp2(-(double)(now_us - st->penalty_us) / half_life_us);
+    if (st->penalty < 1.0) {
+        st->penalty = 0;
+    }
+    st->penalty_us = now_us;
+}
+
+/**
+ * @brief Release a suppressed port whose penalty fell below the reuse threshold
+ *
+ * @return true if the port was released
+ */
+static bool link_try_reuse(port_id_t port_id, uint64_t now_us) {
+    link_port_state_t *st = &g_link.ports[port_id];
+
+    if (!st->suppressed) {
+        return false;
+    }
+
+    if (g_link.config.dampening.enabled) {
+        link_decay(st, now_us);
+        if (st->penalty >= g_link.config.dampening.reuse_threshold) {
+            return false;
+        }
+    }
+
+    st->suppressed = false;
+    g_link.suppressed_count--;
+    LOG_INFO(LOG_CATEGORY_HAL, "Port %u released from link dampening (penalty %.0f)",
+             port_id, st->penalty);
+    return true;
+}
+
+/**
+ * @brief Add a port to a batch if its effective state changed
+ */
+static void link_collect_port(port_id_t port_id, link_event_batch_t *batch) {
+    link_port_state_t *st = &g_link.ports[port_id];
+    bool up = st->link_up && !st->suppressed;
+
+    if (up == st->delivered_up) {
+        return;
+    }
+
+    st->delivered_up = up;
+    bitmap_set(batch->changed, port_id);
+    if (up) {
+        bitmap_set(batch->up, port_id);
+    }
+    batch->count++;
+}
+
+/**
+ * @brief Build the batch of changed ports, with the state lock held
+ */
+static void link_collect(link_event_batch_t *batch) {
+    uint64_t now_us = event_loop_now_us();
+    uint64_t pending[LINK_EVENT_PORT_WORDS];
+
+    memcpy(pending, g_link.pending, sizeof(pending));
+    memset(g_link.pending, 0, sizeof(g_link.pending));
+
+    // Released ports are delivered as if they had been reported
+    if (g_link.suppressed_count) {
+        for (port_id_t port_id = 0; port_id < CONFIG_MAX_PORTS; port_id++) {
+            if (link_try_reuse(port_id, now_us)) {
+                bitmap_set(pending, port_id);
+            }
+        }
+    }
+
+    BITMAP_FOR_EACH(port_id, pending, LINK_EVENT_PORT_WORDS) {
+        uint32_t before = batch->count;
+
+        link_collect_port((port_id_t)port_id, batch);
+        if (batch->count == before) {
+            g_link.stats.coalesced++;
+        }
+    }
+
+    if (g_link.suppressed_count == 0 && g_link.reuse_armed) {
+        event_timer_stop(&g_link.reuse_timer);
+        g_link.reuse_armed = false;
+    }
+}
+
+/**
+ * @brief Hand a batch to every subscriber
+ */
+static void link_deliver(const link_event_batch_t *batch) {
+    link_subscriber_t subs[LINK_EVENT_MAX_SUBSCRIBERS];
+    uint32_t count;
+
+    pthread_mutex_lock(&g_sub_lock);
+    count = g_subscriber_count;
+    memcpy(subs, g_subscribers, count * sizeof(subs[0]));
+    pthread_mutex_unlock(&g_sub_lock);
+
+    for (uint32_t i = 0; i < count; i++) {
+        subs[i].cb(batch, subs[i].arg);
+    }
+}
+
+uint32_t link_event_flush(void) {
+    link_event_batch_t batch;
+
+    memset(&batch, 0, sizeof(batch));
+
+    pthread_mutex_lock(&g_deliver_lock);
+
+    pthread_mutex_lock(&g_link_lock);
+    if (!g_link.initialized) {
+        pthread_mutex_unlock(&g_link_lock);
+        pthread_mutex_unlock(&g_deliver_lock);
+        return 0;
+    }
+    if (g_link.coalesce_armed) {
+        event_timer_stop(&g_link.coalesce_timer);
+        g_link.coalesce_armed = false;
+    }
+    link_collect(&batch);
+    if (batch.count) {
+        g_link.stats.batches++;
+        g_link.stats.changes += batch.count;
+    }
+    pthread_mutex_unlock(&g_link_lock);
+
+    if (batch.count) {
+        LOG_DEBUG(LOG_CATEGORY_HAL, "Delivering link changes of %u ports", batch.count);
+        link_deliver(&batch);
+    }
+
+    pthread_mutex_unlock(&g_deliver_lock);
+    return batch.count;
+}
+
+/**
+ * @brief Coalescing and reuse timers: deliver what is due
+ */
+static void link_timer_cb(event_timer_t *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+
+    link_event_flush();
+}
+
+status_t link_event_init(const link_event_config_t *config) {
+    link_event_config_t defaults;
+
+    if (!config) {
+        link_event_get_default_config(&defaults);
+        config = &defaults;
+    }
+    if (!link_config_valid(config)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_link_lock);
+    if (g_link.initialized) {
+        pthread_mutex_unlock(&g_link_lock);
+        return STATUS_SUCCESS;
+    }
+
+    memset(&g_link, 0, sizeof(g_link));
+    link_apply_config(config);
+    for (port_id_t port_id = 0; port_id < CONFIG_MAX_PORTS; port_id++) {
+        g_link.ports[port_id].link_up = true;
+        g_link.ports[port_id].delivered_up = true;
+    }
+    event_timer_init(&g_link.coalesce_timer, link_timer_cb, NULL);
+    event_timer_init(&g_link.reuse_timer, link_timer_cb, NULL);
+    g_link.initialized = true;
+    pthread_mutex_unlock(&g_link_lock);
+
+    LOG_INFO(LOG_CATEGORY_HAL, "Link events initialized: coalescing %u ms, dampening %s",
+             config->coalesce_ms, config->dampening.enabled ? "on" : "off");
+    return STATUS_SUCCESS;
+}
+
+status_t link_event_shutdown(void) {
+    pthread_mutex_lock(&g_link_lock);
+    if (!g_link.initialized) {
+        pthread_mutex_unlock(&g_link_lock);
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    event_timer_stop(&g_link.coalesce_timer);
+    event_timer_stop(&g_link.reuse_timer);
+    g_link.initialized = false;
+    pthread_mutex_unlock(&g_link_lock);
+
+    // Wait out a delivery in progress
+    pthread_mutex_lock(&g_deliver_lock);
+    pthread_mutex_unlock(&g_deliver_lock);
+
+    LOG_INFO(LOG_CATEGORY_HAL, "Link events shut down");
+    return STATUS_SUCCESS;
+}
+
+status_t link_event_set_config(const link_event_config_t *config) {
+    bool flush = false;
+
+    if (!config || !link_config_valid(config)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_link_lock);
+    if (!g_link.initialized) {
+        pthread_mutex_unlock(&g_link_lock);
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    link_apply_config(config);
+
+    // Without dampening nothing stays suppressed
+    if (!config->dampening.enabled) {
+        for (port_id_t port_id = 0; port_id < CONFIG_MAX_PORTS; port_id++) {
+            g_link.ports[port_id].penalty = 0;
+        }
+        flush = g_link.suppressed_count > 0;
+    }
+    pthread_mutex_unlock(&g_link_lock);
+
+    if (flush) {
+        link_event_flush();
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Charge a down transition to a port, with the state lock held
+ *
+ * @return true if the port got suppressed
+ */
+static bool link_penalize(port_id_t port_id, uint64_t now_us) {
+    const link_dampening_config_t *d = &g_link.config.dampening;
+    link_port_state_t *st = &g_link.ports[port_id];
+
+    link_decay(st, now_us);
+    st->penalty += d->penalty;
+    if (st->penalty > g_link.penalty_ceiling) {
+        st->penalty = g_link.penalty_ceiling;
+    }
+
+    if (st->suppressed || st->penalty <= d->suppress_threshold) {
+        return false;
+    }
+
+    st->suppressed = true;
+    g_link.suppressed_count++;
+    g_link.stats.suppressions++;
+    return true;
+}
+
+status_t link_event_report(port_id_t port_id, bool link_up) {
+    bool deliver_now = false;
+    bool suppressed = false;
+    double penalty = 0;
+
+    if (port_id >= CONFIG_MAX_PORTS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_link_lock);
+    if (!g_link.initialized) {
+        pthread_mutex_unlock(&g_link_lock);
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    link_port_state_t *st = &g_link.ports[port_id];
+    if (st->link_up == link_up) {
+        pthread_mutex_unlock(&g_link_lock);
+        return STATUS_SUCCESS;
+    }
+
+    st->link_up = link_up;
+    g_link.stats.reported++;
+    if (!link_up) {
+        st->flaps++;
+        if (g_link.config.dampening.enabled) {
+            suppressed = link_penalize(port_id, event_loop_now_us());
+            penalty = st->penalty;
+        }
+    }
+    bitmap_set(g_link.pending, port_id);
+
+    if (g_link.config.coalesce_ms == 0) {
+        deliver_now = true;
+    } else if (!g_link.coalesce_armed) {
+        if (event_timer_start(&g_link.coalesce_timer,
+                              (uint64_t)g_link.config.coalesce_ms * 1000, 0) == STATUS_SUCCESS) {
+            g_link.coalesce_armed = true;
+        } else {
+            deliver_now = true;
+        }
+    }
+
+    // Without the event loop suppressed ports are reconsidered on the next flush
+    if (g_link.suppressed_count && !g_link.reuse_armed &&
+        event_timer_start(&g_link.reuse_timer, LINK_EVENT_REUSE_CHECK_MS * 1000,
+                          LINK_EVENT_REUSE_CHECK_MS * 1000) == STATUS_SUCCESS) {
+        g_link.reuse_armed = true;
+    }
+    pthread_mutex_unlock(&g_link_lock);
+
+    if (suppressed) {
+        LOG_WARNING(LOG_CATEGORY_HAL, "Port %u link flapping, suppressed (penalty %.0f)",
+                    port_id, penalty);
+    }
+
+    if (deliver_now) {
+        link_event_flush();
+    }
+    return STATUS_SUCCESS;
+}
+
+status_t link_event_subscribe(link_event_cb_t cb, void *arg) {
+    status_t status = STATUS_SUCCESS;
+
+    if (!cb) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_sub_lock);
+    if (g_subscriber_count >= LINK_EVENT_MAX_SUBSCRIBERS) {
+        status = STATUS_RESOURCE_EXHAUSTED;
+    } else {
+        g_subscribers[g_subscriber_count].cb = cb;
+        g_subscribers[g_subscriber_count].arg = arg;
+        g_subscriber_count++;
+    }
+    pthread_mutex_unlock(&g_sub_lock);
+
+    return status;
+}
+
+status_t link_event_unsubscribe(link_event_cb_t cb, void *arg) {
+    status_t status = STATUS_NOT_FOUND;
+
+    pthread_mutex_lock(&g_sub_lock);
+    for (uint32_t i = 0; i < g_subscriber_count; i++) {
+        if (g_subscribers[i].cb == cb && g_subscribers[i].arg == arg) {
+            memmove(&g_subscribers[i], &g_subscribers[i + 1],
+                    (g_subscriber_count - i - 1) * sizeof(g_subscribers[0]));
+            g_subscriber_count--;
+            status = STATUS_SUCCESS;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_sub_lock);
+
+    return status;
+}
+
+status_t link_event_get_port_info(port_id_t port_id, link_event_port_info_t *info) {
+    if (port_id >= CONFIG_MAX_PORTS || !info) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_link_lock);
+    if (!g_link.initialized) {
+        pthread_mutex_unlock(&g_link_lock);
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    link_port_state_t *st = &g_link.ports[port_id];
+    if (g_link.config.dampening.enabled) {
+        link_decay(st, event_loop_now_us());
+    }
+    info->link_up = st->link_up;
+    info->delivered_up = st->delivered_up;
+    info->suppressed = st->suppressed;
+    info->penalty = (uint32_t)st->penalty;
+    info->flaps = st->flaps;
+    pthread_mutex_unlock(&g_link_lock);
+
+    return STATUS_SUCCESS;
+}
+
+status_t link_event_get_stats(link_event_stats_t *stats) {
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_link_lock);
+    if (!g_link.initialized) {
+        pthread_mutex_unlock(&g_link_lock);
+        return STATUS_NOT_INITIALIZED;
+    }
+    *stats = g_link.stats;
+    pthread_mutex_unlock(&g_link_lock);
+
+    return STATUS_SUCCESS;
+}
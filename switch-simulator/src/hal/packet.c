@@ -12,15 +12,24 @@
 #include "../include/common/error_codes.h"
 #include "../include/hal/port.h"
 #include "../include/hal/hw_resources.h"
+#include "../include/common/config.h"
+#include "../include/common/threading.h"
+#include "../include/common/rcu.h"
+#include "../include/hal/packet_profile.h"
+#include "../include/hal/packet_drop.h"
+#include "../include/common/sim_numa.h"
+#include "../include/common/mem_arena.h"
+#include "../include/common/mem_account.h"
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
 
 /**
  * @brief External interfaces for hardware simulation
  */
 extern status_t hw_sim_transmit_packet(packet_buffer_t *packet, port_id_t port_id);
-extern status_t hw_sim_receive_packet(packet_buffer_t *packet, port_id_t *port_id);
 
 /**
  * @brief Maximum number of packet processors that can be registered
@@ -32,16 +41,35 @@ extern status_t hw_sim_receive_packet(packet_buffer_t *packet, port_id_t *port_i
  */
 typedef struct {
     packet_process_cb_t callback;   /**< Processor callback function */
+    packet_burst_process_cb_t burst_callback; /**< Burst callback (used when callback is NULL) */
     uint32_t priority;              /**< Processing priority */
     void *user_data;                /**< User data for callback */
+    uint32_t handle;                /**< Slot in g_processors */
     bool active;                    /**< Whether this entry is active */
 } packet_processor_t;
 
 /**
  * @brief Array of registered packet processors
+ *
+ * Writer-side registry indexed by handle. Readers never touch it; they use
+ * the published processor table instead.
  */
 static packet_processor_t g_processors[MAX_PACKET_PROCESSORS];
 
+/**
+ * @brief Immutable, priority-sorted snapshot of active processors
+ */
+typedef struct processor_table {
+    uint32_t count;                                 /**< Number of entries */
+    packet_processor_t entries[MAX_PACKET_PROCESSORS]; /**< Active processors in priority order */
+    rcu_head_t rcu;                                 /**< Deferred free after replacement */
+} processor_table_t;
+
+/**
+ * @brief Currently published processor table
+ */
+static processor_table_t *volatile g_active_table = NULL;
+
 /**
  * @brief Number of registered processors
  */
@@ -53,35 +81,485 @@ static uint32_t g_processor_count = 0;
 static bool g_initialized = false;
 
 /**
- * @brief Lock to protect packet processor array during concurrent operations
- * In a real implementation, this would be a mutex or spinlock
+ * @brief Lock serializing writers of the processor registry
+ *
+ * Packet processing does not take this lock.
+ */
+static spinlock_t g_processor_lock = { 0 };
+
+static inline void acquire_lock(void) {
+    spinlock_acquire(&g_processor_lock);
+}
+
+static inline void release_lock(void) {
+    spinlock_release(&g_processor_lock);
+}
+
+/**
+ * @brief Size of the descriptor part of a pool slot, rounded to a cache line
+ */
+#define PACKET_POOL_SLOT_HDR_SIZE   ((sizeof(packet_buffer_t) + 63) & ~(size_t)63)
+
+/**
+ * @brief Size of a single pool slot (descriptor, headroom, data)
+ */
+#define PACKET_POOL_SLOT_SIZE       (PACKET_POOL_SLOT_HDR_SIZE + CONFIG_PACKET_HEADROOM + \
+                                     CONFIG_MAX_PACKET_SIZE)
+
+/**
+ * @brief Size of a single segment pool slot (descriptor, headroom, data)
+ */
+#define PACKET_SEG_SLOT_SIZE        ((PACKET_POOL_SLOT_HDR_SIZE + CONFIG_PACKET_HEADROOM + \
+                                      CONFIG_PACKET_SEGMENT_SIZE + 63) & ~(size_t)63)
+
+/**
+ * @brief Number of free slots kept in each thread's local cache
+ */
+#define PACKET_POOL_CACHE_SIZE      32
+
+/**
+ * @brief Memory arena both pools are carved from
+ */
+#define PACKET_POOL_ARENA           "packet_pool"
+
+/**
+ * @brief Number of slab pools (full-size packets and segments)
  */
-static volatile int g_processor_lock = 0;
+#define PACKET_POOL_COUNT           2
 
 /**
- * @brief Simple lock acquisition function
+ * @brief Free slots of one NUMA node's part of a pool
+ */
+typedef struct {
+    packet_buffer_t **free_stack;   /**< Stack of free slots homed on the node */
+    uint32_t free_top;              /**< Number of entries in free_stack */
+    spinlock_t lock;                /**< Protects free_stack */
+} __attribute__((aligned(64))) packet_pool_node_t;
+
+/**
+ * @brief Packet buffer pool
  *
- * Acquires a lock to protect critical sections of code from concurrent access.
- * In a real implementation, this would use proper synchronization primitives
+ * One contiguous arena of equally sized slots. Each slot holds the
+ * packet_buffer_t descriptor and its data, so an allocation is a single
+ * pointer pop instead of two malloc() calls. There is one pool of
+ * CONFIG_MAX_PACKET_SIZE slots and one of CONFIG_PACKET_SEGMENT_SIZE
+ * slots for chained packets.
+ *
+ * The slot memory comes from the packet_pool memory arena, on huge pages
+ * where the host has them.
+ *
+ * On a NUMA host the arena is cut into one run of slots per node, placed
+ * on that node. Threads take slots from their own node's run and freed
+ * slots go back to the run they came from, so a worker's packets stay in
+ * its local memory; another node's run is used only when its own is empty.
  */
-static inline void acquire_lock(void) {
-    // Simulate lock acquisition with atomic operation
-    // In real implementation, this would be replaced with proper mutex/spinlock code
-    while (__sync_lock_test_and_set(&g_processor_lock, 1)) {
-        // Spin until acquired
+typedef struct {
+    uint8_t *arena;                 /**< Slot memory, page aligned */
+    size_t arena_size;              /**< Bytes of slot memory, a whole number of pages */
+    uint32_t slot_count;            /**< Number of slots in the arena */
+    size_t slot_size;               /**< Bytes per slot */
+    uint32_t data_size;             /**< Inline data capacity of a slot after the headroom */
+    uint32_t cache_index;           /**< Index of the pool's per-thread cache */
+    uint32_t generation;            /**< Bumped on every pool (re)creation */
+    uint32_t node_count;            /**< NUMA nodes the arena is split over */
+    uint32_t node_slots;            /**< Slots per node, the last node may have fewer */
+    packet_pool_node_t nodes[CONFIG_NUMA_MAX_NODES]; /**< Free slots by home node */
+} packet_pool_t;
+
+/**
+ * @brief Per-thread cache of free pool slots
+ */
+typedef struct {
+    packet_buffer_t *slots[PACKET_POOL_CACHE_SIZE]; /**< Cached free slots */
+    uint32_t count;                 /**< Number of cached slots */
+    uint32_t generation;            /**< Pool generation the cache belongs to */
+} packet_pool_cache_t;
+
+static packet_pool_t g_pool = { .cache_index = 0 };
+static packet_pool_t g_seg_pool = { .cache_index = 1 };
+static packet_pool_stats_t g_pool_stats;    /**< Counters of both pools (updated atomically) */
+static THREAD_LOCAL packet_pool_cache_t t_pool_cache[PACKET_POOL_COUNT];
+
+/* Flushes a thread's caches when it exits; set on the thread's first use of a pool */
+static pthread_once_t g_pool_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_pool_key;
+
+static void packet_pool_thread_exit(void *arg);
+
+/**
+ * @brief Check whether a descriptor lives inside a pool arena
+ */
+static inline bool packet_pool_owns(const packet_pool_t *pool, const packet_buffer_t *packet) {
+    const uint8_t *p = (const uint8_t *)packet;
+    return pool->arena != NULL &&
+           p >= pool->arena &&
+           p < pool->arena + (size_t)pool->slot_count * pool->slot_size;
+}
+
+/**
+ * @brief Get the pool a pooled descriptor belongs to
+ */
+static inline packet_pool_t *packet_pool_of(const packet_buffer_t *packet) {
+    return packet_pool_owns(&g_seg_pool, packet) ? &g_seg_pool : &g_pool;
+}
+
+/**
+ * @brief Create the key whose destructor flushes a thread's caches
+ */
+static void packet_pool_make_key(void) {
+    pthread_key_create(&g_pool_key, packet_pool_thread_exit);
+}
+
+/**
+ * @brief Get the local cache of the calling thread, dropping stale contents
+ *
+ * A cache filled before the pool was recreated holds pointers into the old
+ * arena, so it is discarded when the generation does not match. A thread's
+ * first use of a pool lands here too, and sets up the flush at its exit.
+ */
+static inline packet_pool_cache_t *packet_pool_local_cache(packet_pool_t *pool) {
+    packet_pool_cache_t *cache = &t_pool_cache[pool->cache_index];
+    if (cache->generation != pool->generation) {
+        cache->count = 0;
+        cache->generation = pool->generation;
+        pthread_once(&g_pool_key_once, packet_pool_make_key);
+        pthread_setspecific(g_pool_key, t_pool_cache);
+    }
+    return cache;
+}
+
+/**
+ * @brief Create a packet buffer pool
+ *
+ * @param pool Pool to create
+ * @param slot_count Number of slots
+ * @param slot_size Bytes per slot
+ * @param data_size Data capacity of a slot after the headroom
+ * @return STATUS_SUCCESS on success, STATUS_MEMORY_ALLOCATION_FAILED otherwise
+ */
+static status_t packet_pool_create(packet_pool_t *pool, uint32_t slot_count,
+                                   size_t slot_size, uint32_t data_size) {
+    /* Whole pages, so that drivers can register the arena with a device */
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t arena_size = ((size_t)slot_count * slot_size + page_size - 1) & ~(page_size - 1);
+    uint32_t node_count = sim_numa_node_count();
+    void *arena = NULL;
+
+    if (node_count > slot_count) {
+        node_count = slot_count ? slot_count : 1;
+    }
+
+    arena = mem_arena_alloc(mem_arena_get(PACKET_POOL_ARENA), arena_size, page_size);
+    pool->arena = (uint8_t *)arena;
+    pool->arena_size = arena_size;
+    pool->node_count = node_count;
+    pool->node_slots = (slot_count + node_count - 1) / node_count;
+    for (uint32_t n = 0; n < node_count; n++) {
+        pool->nodes[n].free_stack = (packet_buffer_t **)mem_malloc(MEM_TAG_PACKET, pool->node_slots * sizeof(packet_buffer_t *));
+        if (!pool->nodes[n].free_stack && pool->arena) {
+            mem_arena_free(mem_arena_get(PACKET_POOL_ARENA), pool->arena, arena_size);
+            pool->arena = NULL;
+        }
+    }
+    if (!pool->arena) {
+        for (uint32_t n = 0; n < node_count; n++) {
+            mem_free(MEM_TAG_PACKET, pool->nodes[n].free_stack);
+            pool->nodes[n].free_stack = NULL;
+        }
+        return STATUS_MEMORY_ALLOCATION_FAILED;
+    }
+
+    for (uint32_t n = 0; n < node_count; n++) {
+        packet_pool_node_t *node = &pool->nodes[n];
+        uint32_t first = n * pool->node_slots;
+        uint32_t count = first < slot_count ? slot_count - first : 0;
+
+        if (count > pool->node_slots) {
+            count = pool->node_slots;
+        }
+        sim_numa_bind_memory(pool->arena + (size_t)first * slot_size, (size_t)count * slot_size, n);
+
+        /* Push slots in reverse order so that the first allocations are adjacent */
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t idx = first + count - 1 - i;
+            node->free_stack[i] = (packet_buffer_t *)(pool->arena + (size_t)idx * slot_size);
+        }
+        node->free_top = count;
+        spinlock_init(&node->lock);
+        spinlock_set_class(&node->lock, "packet.pool");
     }
+    pool->slot_count = slot_count;
+    pool->slot_size = slot_size;
+    pool->data_size = data_size;
+    pool->generation++;
+
+    LOG_INFO(LOG_CATEGORY_HAL, "Packet buffer pool created: %u slots of %u bytes on %u node(s)",
+             slot_count, data_size, node_count);
+    return STATUS_SUCCESS;
 }
 
 /**
- * @brief Simple lock release function
+ * @brief Destroy a packet buffer pool
+ *
+ * Buffers still held by callers become invalid; a warning is logged if any
+ * are outstanding.
  *
- * Releases a lock previously acquired with acquire_lock().
- * In a real implementation, this would use proper synchronization primitives
+ * @param pool Pool to destroy
+ * @param in_use Number of slots still handed out
  */
-static inline void release_lock(void) {
-    // Simulate lock release with atomic operation
-    // In real implementation, this would be replaced with proper mutex/spinlock code
-    __sync_lock_release(&g_processor_lock);
+static void packet_pool_destroy(packet_pool_t *pool, uint32_t in_use) {
+    if (!pool->arena) {
+        return;
+    }
+
+    if (in_use != 0) {
+        LOG_WARNING(LOG_CATEGORY_HAL, "Destroying packet pool with %u buffers still in use",
+                    in_use);
+    }
+
+    for (uint32_t n = 0; n < pool->node_count; n++) {
+        mem_free(MEM_TAG_PACKET, pool->nodes[n].free_stack);
+        pool->nodes[n].free_stack = NULL;
+        pool->nodes[n].free_top = 0;
+    }
+    mem_arena_free(mem_arena_get(PACKET_POOL_ARENA), pool->arena, pool->arena_size);
+    pool->arena = NULL;
+    pool->generation++;
+}
+
+/**
+ * @brief NUMA node a pool slot is homed on
+ */
+static inline uint32_t packet_pool_slot_node(const packet_pool_t *pool, const packet_buffer_t *packet) {
+    size_t idx = ((const uint8_t *)packet - pool->arena) / pool->slot_size;
+    return (uint32_t)(idx / pool->node_slots);
+}
+
+/**
+ * @brief Take a free slot from a pool
+ *
+ * The thread-local cache is tried first; when it is empty it is refilled
+ * with up to half its capacity in one locked step, from the stack of the
+ * thread's node or, if that is empty, of the next node that has slots.
+ *
+ * @param pool Pool to allocate from
+ * @return Slot descriptor or NULL if the pool is exhausted
+ */
+static packet_buffer_t *packet_pool_get(packet_pool_t *pool) {
+    packet_pool_cache_t *cache = packet_pool_local_cache(pool);
+
+    if (cache->count > 0) {
+        __sync_fetch_and_add(&g_pool_stats.cache_hits, 1);
+        return cache->slots[--cache->count];
+    }
+
+    uint32_t local = pool->node_count > 1 ? sim_numa_current_node() % pool->node_count : 0;
+    for (uint32_t i = 0; i < pool->node_count && cache->count == 0; i++) {
+        packet_pool_node_t *node = &pool->nodes[(local + i) % pool->node_count];
+
+        spinlock_acquire(&node->lock);
+        uint32_t batch = node->free_top < PACKET_POOL_CACHE_SIZE / 2 ?
+                         node->free_top : PACKET_POOL_CACHE_SIZE / 2;
+        for (uint32_t k = 0; k < batch; k++) {
+            cache->slots[cache->count++] = node->free_stack[--node->free_top];
+        }
+        spinlock_release(&node->lock);
+
+        if (i > 0 && batch > 0) {
+            __sync_fetch_and_add(&g_pool_stats.remote_refills, 1);
+        }
+    }
+
+    if (cache->count == 0) {
+        return NULL;
+    }
+    return cache->slots[--cache->count];
+}
+
+/**
+ * @brief Move cached slots back to the free stacks of their home nodes
+ *
+ * @param pool Pool owning the slots
+ * @param cache Cache of the calling thread
+ * @param keep Slots to leave in the cache
+ */
+static void packet_pool_spill(packet_pool_t *pool, packet_pool_cache_t *cache, uint32_t keep) {
+    // Each slot goes home; cached slots are mostly of one node, so locks seldom change
+    packet_pool_node_t *locked = NULL;
+
+    while (cache->count > keep) {
+        packet_buffer_t *slot = cache->slots[--cache->count];
+        packet_pool_node_t *node = &pool->nodes[packet_pool_slot_node(pool, slot)];
+        if (node != locked) {
+            if (locked) {
+                spinlock_release(&locked->lock);
+            }
+            spinlock_acquire(&node->lock);
+            locked = node;
+        }
+        node->free_stack[node->free_top++] = slot;
+    }
+    if (locked) {
+        spinlock_release(&locked->lock);
+    }
+}
+
+/**
+ * @brief Return a slot to its pool
+ *
+ * The slot goes to the thread-local cache; a full cache spills half of its
+ * entries back to the global stack.
+ *
+ * @param pool Pool owning the slot
+ * @param packet Slot descriptor
+ */
+static void packet_pool_put(packet_pool_t *pool, packet_buffer_t *packet) {
+    packet_pool_cache_t *cache = packet_pool_local_cache(pool);
+
+    if (cache->count == PACKET_POOL_CACHE_SIZE) {
+        packet_pool_spill(pool, cache, PACKET_POOL_CACHE_SIZE / 2);
+    }
+
+    cache->slots[cache->count++] = packet;
+}
+
+/**
+ * @brief Key destructor: return an exiting thread's cached slots
+ *
+ * @param arg The thread's t_pool_cache
+ */
+static void packet_pool_thread_exit(void *arg) {
+    packet_pool_cache_t *caches = (packet_pool_cache_t *)arg;
+    packet_pool_t *pools[PACKET_POOL_COUNT] = { &g_pool, &g_seg_pool };
+
+    for (uint32_t i = 0; i < PACKET_POOL_COUNT; i++) {
+        packet_pool_cache_t *cache = &caches[pools[i]->cache_index];
+
+        // Slots of a pool since destroyed are gone with it
+        if (pools[i]->arena && cache->generation == pools[i]->generation) {
+            packet_pool_spill(pools[i], cache, 0);
+        }
+        cache->count = 0;
+    }
+}
+
+/**
+ * @brief Return the calling thread's cached pool slots to the shared pools
+ */
+void packet_pool_thread_flush(void) {
+    packet_pool_thread_exit(t_pool_cache);
+}
+
+/**
+ * @brief Count a slot taken from a pool as in use
+ */
+static inline void packet_pool_count_in_use(const packet_pool_t *pool, int delta) {
+    __sync_fetch_and_add(pool == &g_seg_pool ? &g_pool_stats.seg_in_use : &g_pool_stats.in_use,
+                         (uint32_t)delta);
+}
+
+/**
+ * @brief Get the inline data area of a pool slot
+ */
+#define PACKET_POOL_SLOT_DATA(packet) ((uint8_t *)(packet) + PACKET_POOL_SLOT_HDR_SIZE)
+
+/**
+ * @brief Size of the inline data area of a pool slot (headroom and data)
+ */
+#define PACKET_POOL_SLOT_DATA_SIZE(packet) (CONFIG_PACKET_HEADROOM + packet_pool_of(packet)->data_size)
+
+/**
+ * @brief Shared packet data block
+ *
+ * Created when a buffer is cloned for the first time. From then on the
+ * data belongs to this block and is freed when the last referencing
+ * descriptor is released or made writable.
+ */
+struct packet_shared {
+    volatile uint32_t refcnt;       /**< Descriptors referencing the data */
+    uint8_t *storage;               /**< Start of the data block */
+    packet_buffer_t *slot;          /**< Pool slot holding the data inline, or NULL for heap data */
+};
+
+/**
+ * @brief Drop one holder of a pool slot, returning the slot when unused
+ *
+ * A slot is held by its descriptor and, while its inline data is shared,
+ * by the shared data block.
+ *
+ * @param packet Slot descriptor
+ */
+static void packet_slot_put(packet_buffer_t *packet) {
+    if (__sync_sub_and_fetch(&packet->slot_refs, 1) != 0) {
+        return;
+    }
+
+    packet_pool_t *pool = packet_pool_of(packet);
+    if (!packet_pool_owns(pool, packet)) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Pool packet %p does not belong to the current pool",
+                  (void *)packet);
+        return;
+    }
+
+    packet->data = NULL;
+    packet->head = NULL;
+    packet->flags = 0;
+    packet->next = NULL;
+    packet_pool_count_in_use(pool, -1);
+    packet_pool_put(pool, packet);
+}
+
+/**
+ * @brief Drop one reference to a shared data block
+ *
+ * @param shared Shared data block
+ */
+static void packet_shared_put(packet_shared_t *shared) {
+    if (__sync_sub_and_fetch(&shared->refcnt, 1) != 0) {
+        return;
+    }
+
+    if (shared->slot) {
+        packet_slot_put(shared->slot);
+    } else {
+        mem_free(MEM_TAG_PACKET, shared->storage);
+    }
+    mem_free(MEM_TAG_PACKET, shared);
+}
+
+/**
+ * @brief Allocate a descriptor without data for a shared clone
+ *
+ * Segment pool slots are preferred, then full-size slots; the idle inline
+ * area is later used as the clone's private copy if it needs to be
+ * written and fits.
+ *
+ * @return Zeroed descriptor or NULL on failure
+ */
+static packet_buffer_t *packet_desc_alloc(void) {
+    packet_pool_t *pool = &g_seg_pool;
+    packet_buffer_t *packet = g_seg_pool.arena ? packet_pool_get(&g_seg_pool) : NULL;
+
+    if (!packet && g_pool.arena) {
+        pool = &g_pool;
+        packet = packet_pool_get(&g_pool);
+    }
+
+    if (packet) {
+        memset(packet, 0, sizeof(packet_buffer_t));
+        packet->flags = PACKET_FLAG_POOLED;
+        packet->slot_refs = 1;
+        packet_pool_count_in_use(pool, 1);
+    } else {
+        packet = (packet_buffer_t *)mem_calloc(MEM_TAG_PACKET, 1, sizeof(packet_buffer_t));
+        if (!packet) {
+            return NULL;
+        }
+        __sync_fetch_and_add(&g_pool_stats.heap_fallback_count, 1);
+    }
+
+    __sync_fetch_and_add(&g_pool_stats.alloc_count, 1);
+    return packet;
 }
 
 /**
@@ -101,6 +579,15 @@ static bool packet_buffer_is_valid(const packet_buffer_t *packet) {
     return true;
 }
 
+/**
+ * @brief RCU destructor for a replaced processor table
+ *
+ * @param head RCU header embedded in the table
+ */
+static void processor_table_free(rcu_head_t *head) {
+    mem_free(MEM_TAG_PACKET, (char *)head - offsetof(processor_table_t, rcu));
+}
+
 /**
  * @brief Compare function for sorting processors by priority
  *
@@ -120,13 +607,28 @@ static int compare_processors(const void *a, const void *b) {
 }
 
 /**
- * @brief Sort processors by priority
+ * @brief Publish the registry as a new sorted processor table
+ *
+ * Builds the table from the active registry entries, swaps it in with a
+ * single atomic store and retires the previous table. Readers keep using
+ * whichever table they loaded; it is freed only once all of them have
+ * left their read sections. Called with the writer lock held.
  *
- * Sorts the array of packet processors by their priority values
- * to ensure they are processed in the correct order.
+ * @param table Preallocated table to fill and publish
  */
-static void sort_processors(void) {
-    qsort(g_processors, g_processor_count, sizeof(packet_processor_t), compare_processors);
+static void publish_processors(processor_table_t *table) {
+    table->count = 0;
+    for (uint32_t i = 0; i < g_processor_count; i++) {
+        if (g_processors[i].active) {
+            table->entries[table->count++] = g_processors[i];
+        }
+    }
+    qsort(table->entries, table->count, sizeof(packet_processor_t), compare_processors);
+
+    processor_table_t *old = __atomic_exchange_n(&g_active_table, table, __ATOMIC_SEQ_CST);
+    if (old) {
+        rcu_retire(&old->rcu, processor_table_free);
+    }
 }
 
 /**
@@ -148,7 +650,37 @@ status_t packet_init(void) {
     // Clear all processor slots
     memset(g_processors, 0, sizeof(g_processors));
     g_processor_count = 0;
-    g_processor_lock = 0;
+    spinlock_init(&g_processor_lock);
+    spinlock_set_class(&g_processor_lock, "packet.processors");
+
+    // Pre-allocate packet buffers; without a pool every allocation uses malloc()
+    memset(&g_pool_stats, 0, sizeof(g_pool_stats));
+    if (packet_pool_create(&g_pool, CONFIG_PACKET_BUFFER_POOL_SIZE, PACKET_POOL_SLOT_SIZE,
+                           CONFIG_MAX_PACKET_SIZE) == STATUS_SUCCESS) {
+        g_pool_stats.pool_size = CONFIG_PACKET_BUFFER_POOL_SIZE;
+        g_pool_stats.slot_data_size = CONFIG_MAX_PACKET_SIZE;
+    } else {
+        LOG_WARNING(LOG_CATEGORY_HAL, "Failed to create packet buffer pool, using heap allocation");
+    }
+
+    // Segments for chained packets; without this pool they use full-size slots
+    if (packet_pool_create(&g_seg_pool, CONFIG_PACKET_SEGMENT_POOL_SIZE, PACKET_SEG_SLOT_SIZE,
+                           CONFIG_PACKET_SEGMENT_SIZE) == STATUS_SUCCESS) {
+        g_pool_stats.seg_pool_size = CONFIG_PACKET_SEGMENT_POOL_SIZE;
+    } else {
+        LOG_WARNING(LOG_CATEGORY_HAL, "Failed to create packet segment pool");
+    }
+    g_pool_stats.seg_data_size = CONFIG_PACKET_SEGMENT_SIZE;
+    g_pool_stats.numa_nodes = g_pool.node_count;
+
+    // Processing runs without the drop counters if they cannot be created
+    packet_drop_init();
+
+#if CONFIG_ENABLE_PIPELINE_PROFILING
+    // Processing runs without the histograms if they cannot be created
+    packet_profile_init();
+#endif
+
     g_initialized = true;
     
     LOG_INFO(LOG_CATEGORY_HAL, "Packet processing subsystem initialized successfully");
@@ -178,20 +710,85 @@ status_t packet_shutdown(void) {
     memset(g_processors, 0, sizeof(g_processors));
     g_processor_count = 0;
     g_initialized = false;
+
+    // Packet processing must have stopped by now, so all tables can go
+    processor_table_t *table = __atomic_exchange_n(&g_active_table, NULL, __ATOMIC_SEQ_CST);
+    mem_free(MEM_TAG_PACKET, table);
+    rcu_synchronize();
     
     // Release lock
     release_lock();
+
+    packet_pool_destroy(&g_seg_pool, g_pool_stats.seg_in_use);
+    packet_pool_destroy(&g_pool, g_pool_stats.in_use);
+
+    packet_drop_cleanup();
+#if CONFIG_ENABLE_PIPELINE_PROFILING
+    packet_profile_cleanup();
+#endif
     
     LOG_INFO(LOG_CATEGORY_HAL, "Packet processing subsystem shut down successfully");
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Initialize packet descriptor fields to their default values
+ *
+ * @param packet Packet descriptor
+ * @param head Start of the buffer; CONFIG_PACKET_HEADROOM bytes are reserved
+ * @param size Data buffer capacity after the headroom
+ * @param flags Ownership flags
+ */
+static inline void packet_buffer_init_desc(packet_buffer_t *packet, uint8_t *head,
+                                           uint32_t size, uint32_t flags) {
+    memset(packet, 0, sizeof(packet_buffer_t));
+    packet->head = head;
+    packet->data = head + CONFIG_PACKET_HEADROOM;
+    packet->capacity = size;
+    packet->size = 0;
+    packet->flags = flags;
+
+    // Initialize metadata with default values
+    packet->metadata.port = PORT_ID_INVALID;
+    packet->metadata.direction = PACKET_DIR_INVALID;
+    packet->metadata.timestamp = 0; // In real implementation, set to current time
+    packet->metadata.priority = 0;
+    packet->metadata.vlan = 0;
+    packet->metadata.parsed = 0;
+}
+
+/**
+ * @brief Take a slot from a pool and initialize it as a packet buffer
+ *
+ * @param pool Pool to allocate from
+ * @param size Data capacity after the headroom (at most the slot's)
+ * @param flags Ownership flags
+ * @return Packet buffer or NULL if the pool is exhausted
+ */
+static packet_buffer_t *packet_slot_alloc(packet_pool_t *pool, uint32_t size, uint32_t flags) {
+    packet_buffer_t *packet = packet_pool_get(pool);
+
+    if (!packet) {
+        return NULL;
+    }
+
+    packet_buffer_init_desc(packet, PACKET_POOL_SLOT_DATA(packet), size, flags);
+    packet->slot_refs = 1;
+    packet_pool_count_in_use(pool, 1);
+    __sync_fetch_and_add(&g_pool_stats.alloc_count, 1);
+    return packet;
+}
+
 /**
  * @brief Allocate a new packet buffer
  *
  * Allocates a new packet buffer with the specified capacity.
  * The buffer is initialized with default metadata values.
  *
+ * Requests up to CONFIG_MAX_PACKET_SIZE bytes are served from the packet
+ * pool. Larger requests, or requests made while the pool is exhausted,
+ * fall back to malloc() and are counted in the pool statistics.
+ *
  * @param size Capacity of the new packet buffer in bytes
  * @return Pointer to the newly allocated packet buffer, or NULL on failure
  */
@@ -206,46 +803,134 @@ packet_buffer_t* packet_buffer_alloc(uint32_t size) {
         LOG_ERROR(LOG_CATEGORY_HAL, "Cannot allocate packet buffer with zero size");
         return NULL;
     }
-    
-    // Allocate packet buffer structure
-    packet_buffer_t *packet = (packet_buffer_t *)malloc(sizeof(packet_buffer_t));
+
+    packet_buffer_t *packet = NULL;
+
+    if (size > CONFIG_MAX_PACKET_SIZE) {
+        __sync_fetch_and_add(&g_pool_stats.oversize_count, 1);
+    } else if (g_pool.arena) {
+        packet = packet_slot_alloc(&g_pool, size, PACKET_FLAG_POOLED);
+        if (packet) {
+            return packet;
+        }
+        __sync_fetch_and_add(&g_pool_stats.exhausted_count, 1);
+    }
+
+    // Heap fallback: allocate packet buffer structure
+    packet = (packet_buffer_t *)mem_malloc(MEM_TAG_PACKET, sizeof(packet_buffer_t));
     if (!packet) {
         LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate packet buffer structure");
         return NULL;
     }
     
-    // Initialize structure
-    memset(packet, 0, sizeof(packet_buffer_t));
-    
-    // Allocate data buffer
-    packet->data = (uint8_t *)malloc(size);
-    if (!packet->data) {
+    // Allocate data buffer including headroom
+    uint8_t *head = (uint8_t *)mem_malloc(MEM_TAG_PACKET, CONFIG_PACKET_HEADROOM + (size_t)size);
+    if (!head) {
         LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate packet data buffer of size %u", size);
-        free(packet);
+        mem_free(MEM_TAG_PACKET, packet);
         return NULL;
     }
     
-    packet->capacity = size;
-    packet->size = 0;
-    
-    // Initialize metadata with default values
-    packet->metadata.port = PORT_ID_INVALID;
-    packet->metadata.direction = PACKET_DIR_INVALID;
-    packet->metadata.timestamp = 0; // In real implementation, set to current time
-    packet->metadata.priority = 0;
-//    packet->metadata.vlan_id = 0;
-    packet->metadata.vlan = 0;
+    packet_buffer_init_desc(packet, head, size, 0);
+    __sync_fetch_and_add(&g_pool_stats.heap_fallback_count, 1);
+    __sync_fetch_and_add(&g_pool_stats.alloc_count, 1);
     
-    LOG_DEBUG(LOG_CATEGORY_HAL, "Allocated packet buffer of size %u", size);
+    LOG_DEBUG(LOG_CATEGORY_HAL, "Allocated heap packet buffer of size %u", size);
     return packet;
 }
 
+/**
+ * @brief Allocate a single segment buffer
+ *
+ * Served from the segment pool; when it is exhausted the segment is
+ * taken from the main pool or the heap like any other buffer.
+ *
+ * @return Pointer to the new segment, or NULL on failure
+ */
+packet_buffer_t* packet_segment_alloc(void) {
+    if (!g_initialized) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Packet processing subsystem not initialized");
+        return NULL;
+    }
 
+    packet_buffer_t *segment = NULL;
 
-status_t packet_create(packet_buffer_t **out_pkt)
-{
-    if (!out_pkt) {
-        LOG_ERROR(LOG_CATEGORY_HAL, "packet_create: NULL out_pkt");
+    if (g_seg_pool.arena) {
+        segment = packet_slot_alloc(&g_seg_pool, CONFIG_PACKET_SEGMENT_SIZE,
+                                    PACKET_FLAG_POOLED | PACKET_FLAG_SEGMENT);
+        if (segment) {
+            return segment;
+        }
+        __sync_fetch_and_add(&g_pool_stats.seg_exhausted_count, 1);
+    }
+
+    segment = packet_buffer_alloc(CONFIG_PACKET_SEGMENT_SIZE);
+    if (segment) {
+        segment->flags |= PACKET_FLAG_SEGMENT;
+    }
+    return segment;
+}
+
+/**
+ * @brief Describe the memory of the segment pool
+ *
+ * @param[out] region Arena and slot layout
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER,
+ *         STATUS_NOT_INITIALIZED if there is no segment pool
+ */
+status_t packet_get_segment_region(packet_pool_region_t *region) {
+    if (!region) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (!g_initialized || !g_seg_pool.arena) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    region->base = g_seg_pool.arena;
+    region->size = g_seg_pool.arena_size;
+    region->slot_size = g_seg_pool.slot_size;
+    region->slot_count = g_seg_pool.slot_count;
+    region->data_offset = (uint32_t)PACKET_POOL_SLOT_HDR_SIZE;
+    region->data_size = CONFIG_PACKET_HEADROOM + g_seg_pool.data_size;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get packet buffer pool statistics
+ *
+ * @param[out] stats Pool statistics snapshot
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER if stats is NULL
+ */
+status_t packet_get_pool_stats(packet_pool_stats_t *stats) {
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // Counters are updated independently, so the snapshot is not atomic as a whole
+    *stats = g_pool_stats;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Reset packet buffer pool counters
+ */
+void packet_reset_pool_stats(void) {
+    __sync_lock_test_and_set(&g_pool_stats.alloc_count, 0);
+    __sync_lock_test_and_set(&g_pool_stats.free_count, 0);
+    __sync_lock_test_and_set(&g_pool_stats.cache_hits, 0);
+    __sync_lock_test_and_set(&g_pool_stats.exhausted_count, 0);
+    __sync_lock_test_and_set(&g_pool_stats.oversize_count, 0);
+    __sync_lock_test_and_set(&g_pool_stats.heap_fallback_count, 0);
+    __sync_lock_test_and_set(&g_pool_stats.seg_exhausted_count, 0);
+    __sync_lock_test_and_set(&g_pool_stats.remote_refills, 0);
+}
+
+
+
+status_t packet_create(packet_buffer_t **out_pkt)
+{
+    if (!out_pkt) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "packet_create: NULL out_pkt");
         return ERROR_INVALID_PARAMETER;
     }
 
@@ -282,24 +967,45 @@ void packet_destroy(packet_buffer_t *pkt)
 
 
 /**
- * @brief Free a packet buffer
- * 
- * Frees a packet buffer previously allocated with packet_buffer_alloc().
- * This function securely clears the packet data before freeing the memory.
- * 
- * @param packet Pointer to the packet buffer to free
+ * @brief Release a single segment
+ *
+ * Pool buffers are returned to the pool without touching their data;
+ * heap buffers are cleared before the memory is released. Shared data is
+ * released with its last reference.
+ *
+ * @param packet Segment to release
  */
-void packet_buffer_free(packet_buffer_t *packet) {
-    if (!packet) {
-        LOG_WARNING(LOG_CATEGORY_HAL, "Attempted to free NULL packet buffer");
+static void packet_segment_release(packet_buffer_t *packet) {
+    __sync_fetch_and_add(&g_pool_stats.free_count, 1);
+
+    if (packet->shared) {
+        packet_shared_put(packet->shared);
+        packet->shared = NULL;
+        packet->head = NULL;
+        packet->data = NULL;
+        if (packet->flags & PACKET_FLAG_POOLED) {
+            packet_slot_put(packet);
+        } else {
+            mem_free(MEM_TAG_PACKET, packet);
+        }
+        return;
+    }
+
+    if (packet->flags & PACKET_FLAG_POOLED) {
+        // Data may have been moved to the heap by packet_buffer_resize()
+        if (packet->flags & PACKET_FLAG_EXT_DATA) {
+            mem_free(MEM_TAG_PACKET, packet->head);
+        }
+        packet_slot_put(packet);
         return;
     }
     
     // Free data buffer if present
-    if (packet->data) {
+    if (packet->head) {
         // Securely clear data before freeing
-        memset(packet->data, 0, packet->capacity);
-        free(packet->data);
+        memset(packet->head, 0, packet_headroom(packet) + packet->capacity);
+        mem_free(MEM_TAG_PACKET, packet->head);
+        packet->head = NULL;
         packet->data = NULL;
     }
     
@@ -307,8 +1013,30 @@ void packet_buffer_free(packet_buffer_t *packet) {
     memset(packet, 0, sizeof(packet_buffer_t));
     
     // Free packet structure
-    free(packet);
-    
+    mem_free(MEM_TAG_PACKET, packet);
+}
+
+/**
+ * @brief Free a packet buffer
+ * 
+ * Frees a packet buffer previously allocated with packet_buffer_alloc()
+ * or one of the clone functions, including all chained segments.
+ * 
+ * @param packet Pointer to the packet buffer to free
+ */
+void packet_buffer_free(packet_buffer_t *packet) {
+    if (!packet) {
+        LOG_WARNING(LOG_CATEGORY_HAL, "Attempted to free NULL packet buffer");
+        return;
+    }
+
+    while (packet) {
+        packet_buffer_t *next = packet->next;
+        packet->next = NULL;
+        packet_segment_release(packet);
+        packet = next;
+    }
+
     LOG_DEBUG(LOG_CATEGORY_HAL, "Freed packet buffer");
 }
 
@@ -331,6 +1059,22 @@ void packet_reset(packet_buffer_t *packet) {
         LOG_ERROR(LOG_CATEGORY_HAL, "Cannot reset NULL or invalid packet buffer");
         return;
     }
+    if (packet_make_writable(packet) != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Cannot reset shared packet buffer");
+        return;
+    }
+
+    // Drop chained segments
+    if (packet->next) {
+        packet_buffer_free(packet->next);
+        packet->next = NULL;
+    }
+
+    // Restore default headroom; pushes and pulls only move the data pointer
+    uint32_t total = packet_headroom(packet) + packet->capacity;
+    uint32_t headroom = total > CONFIG_PACKET_HEADROOM ? CONFIG_PACKET_HEADROOM : 0;
+    packet->data = packet->head + headroom;
+    packet->capacity = total - headroom;
 
     // Clear entire data buffer (can be commented out if expensive)
     memset(packet->data, 0, packet->capacity);
@@ -344,6 +1088,9 @@ void packet_reset(packet_buffer_t *packet) {
     packet->metadata.timestamp = 0;
     packet->metadata.priority  = 0;
     packet->metadata.vlan      = 0;
+    packet->metadata.parsed    = 0;
+    packet->metadata.drop_reason = 0;
+    packet->metadata.color     = 0;
 
     // Clear user data if it was used
     packet->user_data = NULL;
@@ -351,6 +1098,157 @@ void packet_reset(packet_buffer_t *packet) {
     LOG_DEBUG(LOG_CATEGORY_HAL, "Packet buffer reset (capacity: %u)", packet->capacity);
 }
 
+/**
+ * @brief Get the length of a packet over all its segments
+ *
+ * @param packet Packet buffer
+ * @return Total number of data bytes (0 for NULL)
+ */
+uint32_t packet_chain_length(const packet_buffer_t *packet) {
+    uint32_t length = 0;
+
+    for (; packet; packet = packet->next) {
+        length += packet->size;
+    }
+    return length;
+}
+
+/**
+ * @brief Get the number of segments of a packet
+ *
+ * @param packet Packet buffer
+ * @return Segment count (0 for NULL)
+ */
+uint32_t packet_segment_count(const packet_buffer_t *packet) {
+    uint32_t count = 0;
+
+    for (; packet; packet = packet->next) {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Get the last segment of a packet
+ */
+static inline packet_buffer_t *packet_chain_tail(packet_buffer_t *packet) {
+    while (packet->next) {
+        packet = packet->next;
+    }
+    return packet;
+}
+
+/**
+ * @brief Find the segment holding a packet offset
+ *
+ * @param packet First segment
+ * @param[in,out] offset Packet offset, replaced by the offset within the segment
+ * @return Segment, or NULL if offset is at or past the end of the packet
+ */
+static inline packet_buffer_t *packet_chain_seek(const packet_buffer_t *packet, uint32_t *offset) {
+    while (packet && *offset >= packet->size) {
+        *offset -= packet->size;
+        packet = packet->next;
+    }
+    return (packet_buffer_t *)packet;
+}
+
+/**
+ * @brief Link a segment (or chain) after the last segment of a packet
+ *
+ * @param packet First segment of the packet
+ * @param segment Segment or chain to append
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER otherwise
+ */
+status_t packet_chain_append(packet_buffer_t *packet, packet_buffer_t *segment) {
+    if (!packet_buffer_is_valid(packet) || !packet_buffer_is_valid(segment) || packet == segment) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Invalid argument to packet_chain_append");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    packet_chain_tail(packet)->next = segment;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Append data to the last segment, linking new segments as needed
+ *
+ * @param packet First segment
+ * @param data Data to append
+ * @param length Number of bytes
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+static status_t packet_chain_append_data(packet_buffer_t *packet, const uint8_t *data, uint32_t length) {
+    packet_buffer_t *tail = packet_chain_tail(packet);
+
+    if (tail != packet) {
+        packet_invalidate_parse(packet);
+    }
+
+    while (length > 0) {
+        status_t cow = packet_make_writable(tail);
+        if (cow != STATUS_SUCCESS) {
+            return cow;
+        }
+
+        uint32_t n = packet_tailroom(tail) < length ? packet_tailroom(tail) : length;
+        memcpy(tail->data + tail->size, data, n);
+        tail->size += n;
+        data += n;
+        length -= n;
+
+        if (length > 0) {
+            packet_buffer_t *segment = packet_segment_alloc();
+            if (!segment) {
+                LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate packet segment");
+                return STATUS_NO_MEMORY;
+            }
+            tail->next = segment;
+            tail = segment;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Copy all segments into the first one and free the rest
+ *
+ * @param packet Packet buffer
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t packet_linearize(packet_buffer_t *packet) {
+    if (!packet_buffer_is_valid(packet)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (!packet->next) {
+        return STATUS_SUCCESS;
+    }
+
+    packet_buffer_t *rest = packet->next;
+    uint32_t head_size = packet->size;
+    uint32_t total = packet_chain_length(packet);
+
+    // Resize only the first segment; it keeps its own bytes when it grows
+    packet->next = NULL;
+    status_t status = packet_buffer_resize(packet, total);
+    if (status != STATUS_SUCCESS) {
+        packet->next = rest;
+        return status;
+    }
+
+    uint32_t offset = head_size;
+    for (packet_buffer_t *seg = rest; seg; seg = seg->next) {
+        memcpy(packet->data + offset, seg->data, seg->size);
+        offset += seg->size;
+    }
+    packet_buffer_free(rest);
+
+    LOG_DEBUG(LOG_CATEGORY_HAL, "Linearized chained packet of %u bytes", total);
+    return STATUS_SUCCESS;
+}
+
 /**
  * @brief Append data to a packet buffer
  *
@@ -383,6 +1281,16 @@ status_t packet_append_data(packet_buffer_t *packet, const uint8_t *data, uint32
         return STATUS_SUCCESS;
     }
 
+    // Segments and chains grow by linking more segments
+    if (packet->next || (packet->flags & PACKET_FLAG_SEGMENT)) {
+        return packet_chain_append_data(packet, data, length);
+    }
+
+    status_t cow = packet_make_writable(packet);
+    if (cow != STATUS_SUCCESS) {
+        return cow;
+    }
+
     // Check buffer capacity
     if (packet->size + length > packet->capacity) {
         LOG_ERROR(LOG_CATEGORY_HAL,
@@ -419,14 +1327,16 @@ status_t packet_peek_byte(const packet_buffer_t *packet, uint32_t offset, uint8_
         LOG_ERROR(LOG_CATEGORY_HAL, "Invalid argument to packet_peek_byte");
         return ERROR_INVALID_PARAMETER;
     }
-    if (offset >= packet->length) {
+    uint32_t seg_offset = offset;
+    const packet_buffer_t *seg = packet_chain_seek(packet, &seg_offset);
+    if (!seg) {
         LOG_ERROR(LOG_CATEGORY_HAL,
                   "Offset out of bounds in packet_peek_byte: %u >= %u",
-                  offset, packet->length);
+                  offset, packet_chain_length(packet));
         return ERROR_PACKET_OPERATION_FAILED;
     }
 
-    *byte = packet->data[offset];
+    *byte = seg->data[seg_offset];
     return STATUS_SUCCESS;
 }
 
@@ -449,14 +1359,30 @@ status_t packet_peek_data(const packet_buffer_t *packet, uint32_t offset, void *
         return ERROR_INVALID_PARAMETER;
     }
     // Проверяем, что весь запрашиваемый диапазон лежит внутри размера
-    if (offset + length > packet->length) {
+    uint32_t total = packet->next ? packet_chain_length(packet) : packet->length;
+    if ((uint64_t)offset + length > total) {
         LOG_ERROR(LOG_CATEGORY_HAL,
                   "Out-of-bounds in packet_peek_data: %u + %u > %u",
-                  offset, length, packet->length);
+                  offset, length, total);
         return ERROR_PACKET_OPERATION_FAILED;
     }
 
-    memcpy(dest, packet->data + offset, length);
+    if (!packet->next) {
+        memcpy(dest, packet->data + offset, length);
+        return STATUS_SUCCESS;
+    }
+
+    // Walk the segments covering [offset, offset + length)
+    uint8_t *out = (uint8_t *)dest;
+    const packet_buffer_t *seg = packet_chain_seek(packet, &offset);
+    while (length > 0) {
+        uint32_t n = seg->size - offset < length ? seg->size - offset : length;
+        memcpy(out, seg->data + offset, n);
+        out += n;
+        length -= n;
+        offset = 0;
+        seg = seg->next;
+    }
     return STATUS_SUCCESS;
 }
 
@@ -476,6 +1402,76 @@ status_t packet_copy_data(const packet_buffer_t *packet, uint32_t offset, void *
     return packet_peek_data(packet, offset, dest, length);
 }
 
+/**
+ * @brief Scratch slots of the thread for ranges spanning segments
+ */
+static __thread struct {
+    uint8_t slot[PACKET_PEEK_SCRATCH_SLOTS][PACKET_PEEK_SCRATCH_SIZE] __attribute__((aligned(16)));
+    uint32_t next;
+} t_peek_scratch;
+
+const void *packet_peek_ptr(const packet_buffer_t *packet, uint32_t offset, uint32_t length)
+{
+    if (!packet || !packet->data) {
+        return NULL;
+    }
+
+    // The common case: an unchained packet, or a range in the first segment
+    if ((uint64_t)offset + length <= packet->size) {
+        return packet->data + offset;
+    }
+    if (!packet->next) {
+        return NULL;
+    }
+
+    uint32_t seg_offset = offset;
+    const packet_buffer_t *seg = packet_chain_seek(packet, &seg_offset);
+    if (!seg) {
+        return NULL;
+    }
+    if ((uint64_t)seg_offset + length <= seg->size) {
+        return seg->data + seg_offset;
+    }
+    if (length > PACKET_PEEK_SCRATCH_SIZE) {
+        return NULL;
+    }
+
+    uint8_t *out = t_peek_scratch.slot[t_peek_scratch.next];
+    uint32_t remaining = length;
+    while (remaining > 0) {
+        if (!seg) {
+            return NULL;
+        }
+        uint32_t n = seg->size - seg_offset < remaining ? seg->size - seg_offset : remaining;
+        memcpy(out + (length - remaining), seg->data + seg_offset, n);
+        remaining -= n;
+        seg_offset = 0;
+        seg = seg->next;
+    }
+    t_peek_scratch.next = (t_peek_scratch.next + 1) % PACKET_PEEK_SCRATCH_SLOTS;
+    return out;
+}
+
+void *packet_write_ptr(packet_buffer_t *packet, uint32_t offset, uint32_t length)
+{
+    if (!packet || !packet->data) {
+        return NULL;
+    }
+
+    uint32_t seg_offset = offset;
+    packet_buffer_t *seg = (uint64_t)offset + length <= packet->size ? packet
+                                                                      : packet_chain_seek(packet, &seg_offset);
+    if (!seg || (uint64_t)seg_offset + length > seg->size) {
+        return NULL;
+    }
+    // The first segment holds the parse cache, which goes with the change
+    if (packet_make_writable(packet) != STATUS_SUCCESS ||
+        (seg != packet && packet_make_writable(seg) != STATUS_SUCCESS)) {
+        return NULL;
+    }
+    return seg->data + seg_offset;
+}
+
 
 
 /**
@@ -497,14 +1493,36 @@ status_t packet_update_data(packet_buffer_t *packet, uint32_t offset, const void
         return ERROR_INVALID_PARAMETER;
     }
     // Проверяем, что обновляемые байты лежат внутри текущего размера пакета
-    if (offset + length > packet->length) {
+    uint32_t total = packet->next ? packet_chain_length(packet) : packet->length;
+    if ((uint64_t)offset + length > total) {
         LOG_ERROR(LOG_CATEGORY_HAL,
                   "Out-of-bounds in packet_update_data: %u + %u > %u",
-                  offset, length, packet->length);
+                  offset, length, total);
         return ERROR_PACKET_OPERATION_FAILED;
     }
 
-    memcpy(packet->data + offset, src, length);
+    status_t cow = packet_make_writable(packet);
+    if (cow != STATUS_SUCCESS) {
+        return cow;
+    }
+
+    // Only the segments that are written need a private copy
+    const uint8_t *in = (const uint8_t *)src;
+    uint32_t seg_offset = offset;
+    uint32_t remaining = length;
+    packet_buffer_t *seg = packet_chain_seek(packet, &seg_offset);
+    while (remaining > 0) {
+        cow = packet_make_writable(seg);
+        if (cow != STATUS_SUCCESS) {
+            return cow;
+        }
+        uint32_t n = seg->size - seg_offset < remaining ? seg->size - seg_offset : remaining;
+        memcpy(seg->data + seg_offset, in, n);
+        in += n;
+        remaining -= n;
+        seg_offset = 0;
+        seg = seg->next;
+    }
     LOG_DEBUG(LOG_CATEGORY_HAL,
               "Updated %u bytes at offset %u in packet",
               length, offset);
@@ -520,7 +1538,8 @@ status_t packet_update_data(packet_buffer_t *packet, uint32_t offset, const void
  * 
  * Creates a new packet buffer that is a copy of the original.
  * The new buffer has the same size, capacity, and content as the original.
- * Metadata is also copied, but user data is not.
+ * Metadata is also copied, but user data is not. Chained packets are
+ * cloned into a single linear buffer.
  * 
  * @param packet Pointer to the packet buffer to clone
  * @return Pointer to the newly allocated clone, or NULL on failure
@@ -536,16 +1555,17 @@ packet_buffer_t* packet_buffer_clone(const packet_buffer_t *packet) {
         return NULL;
     }
     
-    // Allocate new packet with same capacity
-    packet_buffer_t *clone = packet_buffer_alloc(packet->capacity);
+    // Allocate new packet with same capacity; a chain is cloned into one buffer
+    uint32_t length = packet->next ? packet_chain_length(packet) : packet->size;
+    packet_buffer_t *clone = packet_buffer_alloc(packet->capacity > length ? packet->capacity : length);
     if (!clone) {
         LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate memory for packet clone");
         return NULL;
     }
     
     // Copy data
-    memcpy(clone->data, packet->data, packet->size);
-    clone->size = packet->size;
+    packet_copy_data(packet, 0, clone->data, length);
+    clone->size = length;
     
     // Copy metadata
     clone->metadata = packet->metadata;
@@ -558,82 +1578,318 @@ packet_buffer_t* packet_buffer_clone(const packet_buffer_t *packet) {
 }
 
 /**
- * @brief Resize a packet buffer
- * 
- * Resizes a packet buffer to the specified size. If the new size fits within
- * the current capacity, no memory reallocation is performed. Otherwise,
- * the buffer is reallocated to the new size.
- * 
- * @param packet Pointer to the packet buffer to resize
- * @param new_size New size for the packet buffer in bytes
- * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ * @brief Clone a single segment sharing its data
+ *
+ * @param packet Segment to clone
+ * @return Clone of the segment (not linked), or NULL on failure
  */
-status_t packet_buffer_resize(packet_buffer_t *packet, uint32_t new_size) {
+static packet_buffer_t *packet_segment_clone_shared(const packet_buffer_t *packet) {
+    // Sharing state lives in the source descriptor
+    packet_buffer_t *src = (packet_buffer_t *)packet;
+
+    if (!src->shared) {
+        packet_shared_t *shared = (packet_shared_t *)mem_malloc(MEM_TAG_PACKET, sizeof(packet_shared_t));
+        if (!shared) {
+            LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate shared packet data block");
+            return NULL;
+        }
+
+        shared->refcnt = 1;
+        shared->storage = src->head;
+        if ((src->flags & PACKET_FLAG_POOLED) && !(src->flags & PACKET_FLAG_EXT_DATA)) {
+            // Inline data keeps the source's pool slot alive
+            shared->slot = src;
+            __sync_fetch_and_add(&src->slot_refs, 1);
+        } else {
+            shared->slot = NULL;
+        }
+        src->flags &= ~PACKET_FLAG_EXT_DATA;
+        src->shared = shared;
+    }
+
+    packet_buffer_t *clone = packet_desc_alloc();
+    if (!clone) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate descriptor for packet clone");
+        return NULL;
+    }
+
+    __sync_fetch_and_add(&src->shared->refcnt, 1);
+    clone->shared = src->shared;
+    clone->head = src->head;
+    clone->data = src->data;
+    clone->size = src->size;
+    clone->capacity = src->capacity;
+    clone->metadata = src->metadata;
+    clone->user_data = NULL;
+
+    clone->flags |= src->flags & PACKET_FLAG_SEGMENT;
+    return clone;
+}
+
+/**
+ * @brief Clone a packet buffer sharing its data
+ *
+ * On the first clone the source's data is moved into a shared block that
+ * both descriptors reference. Further clones only take another reference,
+ * so flooding to N ports costs N descriptors instead of N payload copies.
+ * Every segment of a chained packet is shared the same way.
+ *
+ * @param packet Pointer to the packet buffer to clone
+ * @return Pointer to the clone, or NULL on failure
+ */
+packet_buffer_t* packet_buffer_clone_shared(const packet_buffer_t *packet) {
     if (!g_initialized) {
         LOG_ERROR(LOG_CATEGORY_HAL, "Packet processing subsystem not initialized");
-        return STATUS_NOT_INITIALIZED;
+        return NULL;
     }
-    
+
     if (!packet_buffer_is_valid(packet)) {
-        LOG_ERROR(LOG_CATEGORY_HAL, "Cannot resize invalid packet buffer");
-        return STATUS_INVALID_PARAMETER;
-    }
-    
-    // Check for zero size
-    if (new_size == 0) {
-        LOG_ERROR(LOG_CATEGORY_HAL, "Cannot resize packet to zero size");
-        return STATUS_INVALID_PARAMETER;
-    }
-    
-    // If new size fits in current capacity, just update size
-    if (new_size <= packet->capacity) {
-        packet->size = new_size;
-        LOG_DEBUG(LOG_CATEGORY_HAL, "Resized packet buffer to %u bytes (within capacity)", new_size);
-        return STATUS_SUCCESS;
+        LOG_ERROR(LOG_CATEGORY_HAL, "Cannot clone invalid packet buffer");
+        return NULL;
     }
-    
-    // Otherwise, need to reallocate
-    uint8_t *new_data = (uint8_t *)realloc(packet->data, new_size);
-    if (!new_data) {
-        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to resize packet buffer to %u bytes", new_size);
-        return STATUS_NO_MEMORY;
 
-        //  return STATUS_MEMORY_ALLOCATION_FAILED;
-        //  need to change STATUS_NO_MEMORY to STATUS_MEMORY_ALLOCATION_FAILED
-        //  and remove <temp1> in include/common/error_codes.h
+    packet_buffer_t *clone = NULL;
+    packet_buffer_t **link = &clone;
+    for (const packet_buffer_t *seg = packet; seg; seg = seg->next) {
+        *link = packet_segment_clone_shared(seg);
+        if (!*link) {
+            if (clone) {
+                packet_buffer_free(clone);
+            }
+            return NULL;
+        }
+        link = &(*link)->next;
     }
-    
-    packet->data = new_data;
-    packet->capacity = new_size;
-    packet->size = new_size;
-    
-    LOG_DEBUG(LOG_CATEGORY_HAL, "Resized packet buffer to %u bytes (reallocation)", new_size);
-    return STATUS_SUCCESS;
-}
+
+    LOG_DEBUG(LOG_CATEGORY_HAL, "Shared clone of packet buffer of size %u", packet->size);
+    return clone;
+}
 
 /**
- * @brief Register a packet processor
+ * @brief Create a packet referencing a byte range of another packet
+ *
+ * Each segment overlapping the range is cloned with packet_buffer_clone_shared()
+ * semantics and trimmed to the range, so no payload is copied. The slice
+ * gets the source metadata with an empty header cache.
+ *
+ * @param packet Source packet
+ * @param offset Start of the range
+ * @param length Number of bytes
+ * @return Pointer to the slice, or NULL on failure
+ */
+packet_buffer_t* packet_buffer_slice(const packet_buffer_t *packet, uint32_t offset, uint32_t length) {
+    if (!g_initialized) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Packet processing subsystem not initialized");
+        return NULL;
+    }
+
+    if (!packet_buffer_is_valid(packet) || length == 0 ||
+        (uint64_t)offset + length > packet_chain_length(packet)) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Invalid range for packet_buffer_slice");
+        return NULL;
+    }
+
+    packet_buffer_t *slice = NULL;
+    packet_buffer_t **link = &slice;
+    const packet_buffer_t *seg = packet_chain_seek(packet, &offset);
+    while (length > 0) {
+        uint32_t n = seg->size - offset < length ? seg->size - offset : length;
+        packet_buffer_t *clone = packet_segment_clone_shared(seg);
+        if (!clone) {
+            if (slice) {
+                packet_buffer_free(slice);
+            }
+            return NULL;
+        }
+
+        // Only the descriptor moves; the shared bytes stay where they are
+        clone->data += offset;
+        clone->capacity -= offset;
+        clone->size = n;
+        *link = clone;
+        link = &clone->next;
+
+        length -= n;
+        offset = 0;
+        seg = seg->next;
+    }
+
+    slice->metadata = packet->metadata;
+    packet_invalidate_parse(slice);
+    return slice;
+}
+
+/**
+ * @brief Give a packet buffer a private copy of its data if it is shared
+ *
+ * Also drops the cached header offsets, since callers write to the data
+ * afterwards.
+ *
+ * The last holder of a shared block takes its storage back without
+ * copying. Otherwise the data is copied into the descriptor's idle pool
+ * slot area when possible, or into a new heap block.
+ *
+ * @param packet Pointer to the packet buffer
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t packet_make_writable(packet_buffer_t *packet) {
+    if (!packet) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // Every caller is about to change the data, so the header cache goes
+    packet_invalidate_parse(packet);
+
+    packet_shared_t *shared = packet->shared;
+    if (!shared) {
+        return STATUS_SUCCESS;
+    }
+
+    bool pooled = (packet->flags & PACKET_FLAG_POOLED) != 0;
+
+    if (shared->refcnt == 1 && (shared->slot == NULL || shared->slot == packet)) {
+        // Sole holder: the storage becomes private again
+        if (shared->slot == packet) {
+            __sync_fetch_and_sub(&packet->slot_refs, 1);
+        } else if (pooled) {
+            packet->flags |= PACKET_FLAG_EXT_DATA;
+        }
+        packet->shared = NULL;
+        mem_free(MEM_TAG_PACKET, shared);
+        return STATUS_SUCCESS;
+    }
+
+    uint32_t headroom = packet_headroom(packet);
+    size_t total = (size_t)headroom + packet->capacity;
+    uint8_t *new_head;
+    bool ext;
+
+    if (pooled && shared->slot != packet && total <= PACKET_POOL_SLOT_DATA_SIZE(packet)) {
+        new_head = PACKET_POOL_SLOT_DATA(packet);
+        ext = false;
+    } else {
+        new_head = (uint8_t *)mem_malloc(MEM_TAG_PACKET, total);
+        if (!new_head) {
+            LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate private copy of shared packet data");
+            return STATUS_NO_MEMORY;
+        }
+        ext = pooled;
+    }
+
+    memcpy(new_head + headroom, packet->data, packet->size);
+    packet->head = new_head;
+    packet->data = new_head + headroom;
+    packet->flags = ext ? (packet->flags | PACKET_FLAG_EXT_DATA) :
+                          (packet->flags & ~PACKET_FLAG_EXT_DATA);
+    packet->shared = NULL;
+    packet_shared_put(shared);
+
+    LOG_DEBUG(LOG_CATEGORY_HAL, "Copied shared packet data on write (%u bytes)", packet->size);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Resize a packet buffer
  * 
- * Registers a callback function to process packets. The callback will be
- * called when packets are processed, in order of priority (lower priority
- * values are processed first).
+ * Resizes a packet buffer to the specified size. If the new size fits within
+ * the current capacity, no memory reallocation is performed. Otherwise,
+ * the buffer is reallocated to the new size.
  * 
- * @param callback Function to call for packet processing
+ * @param packet Pointer to the packet buffer to resize
+ * @param new_size New size for the packet buffer in bytes
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t packet_buffer_resize(packet_buffer_t *packet, uint32_t new_size) {
+    if (!g_initialized) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Packet processing subsystem not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+    
+    if (!packet_buffer_is_valid(packet)) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Cannot resize invalid packet buffer");
+        return STATUS_INVALID_PARAMETER;
+    }
+    
+    // Check for zero size
+    if (new_size == 0) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Cannot resize packet to zero size");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // Sizes refer to the whole packet, so chains are flattened first
+    if (packet->next) {
+        status_t lin = packet_linearize(packet);
+        if (lin != STATUS_SUCCESS) {
+            return lin;
+        }
+    }
+
+    status_t cow = packet_make_writable(packet);
+    if (cow != STATUS_SUCCESS) {
+        return cow;
+    }
+    
+    // If new size fits in current capacity, just update size
+    if (new_size <= packet->capacity) {
+        packet->size = new_size;
+        LOG_DEBUG(LOG_CATEGORY_HAL, "Resized packet buffer to %u bytes (within capacity)", new_size);
+        return STATUS_SUCCESS;
+    }
+    
+    // Otherwise, need to reallocate keeping the current headroom. Data inside
+    // a pool slot cannot be realloc()ed, so it is copied out to the heap once.
+    uint32_t headroom = packet_headroom(packet);
+    uint8_t *new_head;
+    if ((packet->flags & PACKET_FLAG_POOLED) && !(packet->flags & PACKET_FLAG_EXT_DATA)) {
+        new_head = (uint8_t *)mem_malloc(MEM_TAG_PACKET, (size_t)headroom + new_size);
+        if (new_head) {
+            memcpy(new_head + headroom, packet->data, packet->size);
+            packet->flags |= PACKET_FLAG_EXT_DATA;
+        }
+    } else {
+        new_head = (uint8_t *)mem_realloc(MEM_TAG_PACKET, packet->head, (size_t)headroom + new_size);
+    }
+    if (!new_head) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to resize packet buffer to %u bytes", new_size);
+        return STATUS_NO_MEMORY;
+
+        //  return STATUS_MEMORY_ALLOCATION_FAILED;
+        //  need to change STATUS_NO_MEMORY to STATUS_MEMORY_ALLOCATION_FAILED
+        //  and remove <temp1> in include/common/error_codes.h
+    }
+    
+    packet->head = new_head;
+    packet->data = new_head + headroom;
+    packet->capacity = new_size;
+    packet->size = new_size;
+    
+    LOG_DEBUG(LOG_CATEGORY_HAL, "Resized packet buffer to %u bytes (reallocation)", new_size);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Add a processor entry to the registry
+ *
+ * Exactly one of callback and burst_callback is expected to be set.
+ *
+ * @param callback Per-packet callback or NULL
+ * @param burst_callback Burst callback or NULL
  * @param priority Priority of the processor (lower values are processed first)
  * @param user_data User data to pass to the callback
  * @param handle_out Pointer to store the handle for the registered processor
  * @return STATUS_SUCCESS on success, appropriate error code otherwise
  */
-status_t packet_register_processor(packet_process_cb_t callback, 
-                                  uint32_t priority, 
-                                  void *user_data, 
-                                  uint32_t *handle_out) {
+static status_t packet_register_entry(packet_process_cb_t callback,
+                                      packet_burst_process_cb_t burst_callback,
+                                      uint32_t priority,
+                                      void *user_data,
+                                      uint32_t *handle_out) {
     if (!g_initialized) {
         LOG_ERROR(LOG_CATEGORY_HAL, "Packet processing subsystem not initialized");
         return STATUS_NOT_INITIALIZED;
     }
     
-    if (!callback) {
+    if (!callback && !burst_callback) {
         LOG_ERROR(LOG_CATEGORY_HAL, "Cannot register NULL callback");
         return STATUS_INVALID_PARAMETER;
     }
@@ -643,17 +1899,16 @@ status_t packet_register_processor(packet_process_cb_t callback,
         return STATUS_INVALID_PARAMETER;
     }
     
+    processor_table_t *table = (processor_table_t *)mem_malloc(MEM_TAG_PACKET, sizeof(processor_table_t));
+    if (!table) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate packet processor table");
+        return STATUS_NO_MEMORY;
+    }
+
     // Acquire lock to prevent concurrent modification
     acquire_lock();
     
-    if (g_processor_count >= MAX_PACKET_PROCESSORS) {
-        LOG_ERROR(LOG_CATEGORY_HAL, "Maximum number of packet processors (%d) already registered", 
-                 MAX_PACKET_PROCESSORS);
-        release_lock();
-        return STATUS_RESOURCE_EXHAUSTED;
-    }
-    
-    // Find an unused slot
+    // Find an unused slot; slots are stable and double as handles
     uint32_t slot;
     for (slot = 0; slot < MAX_PACKET_PROCESSORS; slot++) {
         if (!g_processors[slot].active) {
@@ -661,10 +1916,20 @@ status_t packet_register_processor(packet_process_cb_t callback,
         }
     }
 
+    if (slot >= MAX_PACKET_PROCESSORS) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Maximum number of packet processors (%d) already registered", 
+                 MAX_PACKET_PROCESSORS);
+        release_lock();
+        mem_free(MEM_TAG_PACKET, table);
+        return STATUS_RESOURCE_EXHAUSTED;
+    }
+
     // Fill the slot
     g_processors[slot].callback = callback;
+    g_processors[slot].burst_callback = burst_callback;
     g_processors[slot].priority = priority;
     g_processors[slot].user_data = user_data;
+    g_processors[slot].handle = slot;
     g_processors[slot].active = true;
     
     // Update count if needed
@@ -672,8 +1937,8 @@ status_t packet_register_processor(packet_process_cb_t callback,
         g_processor_count = slot + 1;
     }
     
-    // Sort processors by priority
-    sort_processors();
+    // Publish a new sorted snapshot for the fast path
+    publish_processors(table);
     
     // Return handle
     *handle_out = slot;
@@ -681,11 +1946,58 @@ status_t packet_register_processor(packet_process_cb_t callback,
     // Release lock
     release_lock();
     
-    LOG_INFO(LOG_CATEGORY_HAL, "Registered packet processor with priority %u, handle %u", 
-             priority, slot);
+    LOG_INFO(LOG_CATEGORY_HAL, "Registered %spacket processor with priority %u, handle %u", 
+             burst_callback ? "burst " : "", priority, slot);
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Register a packet processor
+ * 
+ * Registers a callback function to process packets. The callback will be
+ * called when packets are processed, in order of priority (lower priority
+ * values are processed first).
+ * 
+ * @param callback Function to call for packet processing
+ * @param priority Priority of the processor (lower values are processed first)
+ * @param user_data User data to pass to the callback
+ * @param handle_out Pointer to store the handle for the registered processor
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t packet_register_processor(packet_process_cb_t callback, 
+                                  uint32_t priority, 
+                                  void *user_data, 
+                                  uint32_t *handle_out) {
+    if (!callback) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Cannot register NULL callback");
+        return STATUS_INVALID_PARAMETER;
+    }
+    return packet_register_entry(callback, NULL, priority, user_data, handle_out);
+}
+
+/**
+ * @brief Register a burst packet processor
+ *
+ * Registers a callback that receives all packets of a burst that reached
+ * its stage at once, letting it amortize table lookups across the burst.
+ *
+ * @param callback Function to call for burst processing
+ * @param priority Priority of the processor (lower values are processed first)
+ * @param user_data User data to pass to the callback
+ * @param handle_out Pointer to store the handle for the registered processor
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t packet_register_burst_processor(packet_burst_process_cb_t callback,
+                                         uint32_t priority,
+                                         void *user_data,
+                                         uint32_t *handle_out) {
+    if (!callback) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Cannot register NULL burst callback");
+        return STATUS_INVALID_PARAMETER;
+    }
+    return packet_register_entry(NULL, callback, priority, user_data, handle_out);
+}
+
 /**
  * @brief Unregister a packet processor
  * 
@@ -702,24 +2014,31 @@ status_t packet_unregister_processor(uint32_t handle) {
         return STATUS_NOT_INITIALIZED;
     }
     
-    // Acquire lock to prevent concurrent modification
-    acquire_lock();
-    
     if (handle >= MAX_PACKET_PROCESSORS) {
         LOG_ERROR(LOG_CATEGORY_HAL, "Invalid processor handle: %u", handle);
-        release_lock();
         return STATUS_INVALID_PARAMETER;
     }
+
+    processor_table_t *table = (processor_table_t *)mem_malloc(MEM_TAG_PACKET, sizeof(processor_table_t));
+    if (!table) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate packet processor table");
+        return STATUS_NO_MEMORY;
+    }
+
+    // Acquire lock to prevent concurrent modification
+    acquire_lock();
     
     if (!g_processors[handle].active) {
         LOG_WARNING(LOG_CATEGORY_HAL, "Processor handle %u is not active", handle);
         release_lock();
+        mem_free(MEM_TAG_PACKET, table);
         return STATUS_INVALID_PARAMETER;
     }
     
     // Deactivate the processor
     g_processors[handle].active = false;
     g_processors[handle].callback = NULL;
+    g_processors[handle].burst_callback = NULL;
     g_processors[handle].user_data = NULL;
     
     // Recalculate processor count if needed
@@ -729,16 +2048,40 @@ status_t packet_unregister_processor(uint32_t handle) {
         }
     }
     
-    // Sort processors to maintain order
-    sort_processors();
+    // Publish a new snapshot without the processor
+    publish_processors(table);
     
     // Release lock
     release_lock();
     
+#if CONFIG_ENABLE_PIPELINE_PROFILING
+    // A processor registered later in the slot starts with an empty histogram
+    packet_profile_set_name(handle, NULL);
+    packet_profile_clear(handle);
+#endif
+    
     LOG_INFO(LOG_CATEGORY_HAL, "Unregistered packet processor with handle %u", handle);
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Name a registered processor for pipeline profiling reports
+ *
+ * @param handle Handle of the processor
+ * @param name Stage name
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t packet_set_processor_name(uint32_t handle, const char *name) {
+    if (handle >= MAX_PACKET_PROCESSORS || !name) {
+        return STATUS_INVALID_PARAMETER;
+    }
+#if CONFIG_ENABLE_PIPELINE_PROFILING
+    return packet_profile_set_name(handle, name);
+#else
+    return STATUS_SUCCESS;
+#endif
+}
+
 /**
  * @brief Process a packet through registered processors
  * 
@@ -757,6 +2100,7 @@ packet_result_t packet_process(packet_buffer_t *packet) {
     
     if (!packet_buffer_is_valid(packet)) {
         LOG_ERROR(LOG_CATEGORY_HAL, "Cannot process invalid packet");
+        packet_drop_count(NULL, PACKET_DROP_INVALID);
         return PACKET_RESULT_DROP;
     }
     
@@ -842,50 +2186,196 @@ packet_result_t packet_process(packet_buffer_t *packet) {
     // Prevent deep recursion which could lead to stack overflow
     if (recursion_depth > 16) { // Arbitrary limit to prevent stack overflow
         LOG_ERROR(LOG_CATEGORY_HAL, "Packet recirculation depth exceeded limit (16), dropping packet");
+        packet_drop_count(packet, PACKET_DROP_RECIRC_LIMIT);
         recursion_depth--;
         return PACKET_RESULT_DROP;
     }
     
-    // Acquire lock for reading (could use reader lock in real implementation)
-    acquire_lock();
-    
-    // Make a local copy of active processors for consistent execution
-    // This allows us to release the lock sooner
-    uint32_t processor_count = g_processor_count;
-    packet_processor_t processors[MAX_PACKET_PROCESSORS];
-    memcpy(processors, g_processors, processor_count * sizeof(packet_processor_t));
-    
-    // Release lock as we don't need to keep it during processing
-    release_lock();
+    // Use the published snapshot: no lock and no copy on the fast path
+    if (rcu_read_lock() != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to register packet processing thread, dropping packet");
+        packet_drop_count(packet, PACKET_DROP_INTERNAL);
+        recursion_depth--;
+        return PACKET_RESULT_DROP;
+    }
+    const processor_table_t *table = __atomic_load_n(&g_active_table, __ATOMIC_SEQ_CST);
+
+    uint32_t processor_count = table ? table->count : 0;
+    const packet_processor_t *processors = table ? table->entries : NULL;
     
     // Process packet through all active processors in priority order
     for (uint32_t i = 0; i < processor_count; i++) {
-        if (processors[i].active && processors[i].callback) {
-            // Call the processor
+#if CONFIG_ENABLE_PIPELINE_PROFILING
+        perf_sample_t events;
+        perf_counters_t *pc = packet_profile_counters_begin(&events);
+        uint64_t start = packet_profile_now();
+#endif
+        // Call the processor; burst processors get a burst of one
+        if (processors[i].callback) {
             result = processors[i].callback(packet, processors[i].user_data);
+        } else {
+            processors[i].burst_callback(&packet, 1, &result, processors[i].user_data);
+        }
+#if CONFIG_ENABLE_PIPELINE_PROFILING
+        packet_profile_record(processors[i].handle, packet_profile_now() - start, 1);
+        packet_profile_counters_end(pc, processors[i].handle, &events);
+#endif
 
-            // If processor consumed or dropped the packet, stop processing
-            if (result == PACKET_RESULT_CONSUME || result == PACKET_RESULT_DROP) {
-                LOG_DEBUG(LOG_CATEGORY_HAL, "Packet processing stopped with result %d by processor %u",
-                          result, i);
-                break;
+        // If processor consumed or dropped the packet, stop processing
+        if (result == PACKET_RESULT_CONSUME || result == PACKET_RESULT_DROP) {
+            LOG_DEBUG(LOG_CATEGORY_HAL, "Packet processing stopped with result %d by processor %u",
+                      result, i);
+            if (result == PACKET_RESULT_DROP) {
+                packet_drop_count(packet, PACKET_DROP_PIPELINE);
             }
+            break;
+        }
 
-            // If processor requested recirculation, start over with processing
-            if (result == PACKET_RESULT_RECIRCULATE) {
-                LOG_DEBUG(LOG_CATEGORY_HAL, "Packet recirculation requested by processor %u", i);
-                result = packet_process(packet);
-                recursion_depth--;
-                return result;
-            }
+        // If processor requested recirculation, start over with processing
+        if (result == PACKET_RESULT_RECIRCULATE) {
+            LOG_DEBUG(LOG_CATEGORY_HAL, "Packet recirculation requested by processor %u", i);
+            result = packet_process(packet);
+            rcu_read_unlock();
+            recursion_depth--;
+            return result;
         }
     }
 
+    rcu_read_unlock();
     recursion_depth--;
     LOG_DEBUG(LOG_CATEGORY_HAL, "Packet processing completed with result %d", result);
     return result;
 }
 
+/**
+ * @brief Run one chunk of a burst through a processor list
+ *
+ * Packets leave the active set as soon as a stage drops or consumes them.
+ * Recirculated packets finish through packet_process().
+ *
+ * @param pkts Packets of the chunk
+ * @param count Number of packets (at most PACKET_BURST_MAX)
+ * @param results Per-packet results
+ * @param processors Processor list snapshot
+ * @param processor_count Number of entries in processors
+ */
+static void packet_process_chunk(packet_buffer_t **pkts, uint32_t count, packet_result_t *results,
+                                 const packet_processor_t *processors, uint32_t processor_count) {
+    packet_buffer_t *active[PACKET_BURST_MAX];
+    uint32_t active_idx[PACKET_BURST_MAX];
+    packet_result_t stage[PACKET_BURST_MAX];
+    uint32_t n_active = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!packet_buffer_is_valid(pkts[i])) {
+            results[i] = PACKET_RESULT_DROP;
+            packet_drop_count(NULL, PACKET_DROP_INVALID);
+            continue;
+        }
+        results[i] = PACKET_RESULT_FORWARD;
+        active[n_active] = pkts[i];
+        active_idx[n_active] = i;
+        n_active++;
+    }
+
+    for (uint32_t p = 0; p < processor_count && n_active > 0; p++) {
+        const packet_processor_t *proc = &processors[p];
+        if (!proc->active) {
+            continue;
+        }
+
+#if CONFIG_ENABLE_PIPELINE_PROFILING
+        perf_sample_t events;
+        perf_counters_t *pc = packet_profile_counters_begin(&events);
+        uint64_t start = packet_profile_now();
+#endif
+        if (proc->burst_callback) {
+            proc->burst_callback(active, n_active, stage, proc->user_data);
+        } else if (proc->callback) {
+            for (uint32_t j = 0; j < n_active; j++) {
+                stage[j] = proc->callback(active[j], proc->user_data);
+            }
+        } else {
+            continue;
+        }
+#if CONFIG_ENABLE_PIPELINE_PROFILING
+        packet_profile_record(proc->handle, packet_profile_now() - start, n_active);
+        packet_profile_counters_end(pc, proc->handle, &events);
+#endif
+
+        // Compact the active set, keeping packets that are still forwarded
+        uint32_t kept = 0;
+        for (uint32_t j = 0; j < n_active; j++) {
+            uint32_t idx = active_idx[j];
+            results[idx] = stage[j];
+
+            if (stage[j] == PACKET_RESULT_DROP) {
+                packet_drop_count(active[j], PACKET_DROP_PIPELINE);
+                continue;
+            }
+            if (stage[j] == PACKET_RESULT_CONSUME) {
+                continue;
+            }
+            if (stage[j] == PACKET_RESULT_RECIRCULATE) {
+                results[idx] = packet_process(active[j]);
+                continue;
+            }
+            active[kept] = active[j];
+            active_idx[kept] = idx;
+            kept++;
+        }
+        n_active = kept;
+    }
+}
+
+/**
+ * @brief Process a burst of packets through registered processors
+ *
+ * The published processor table is loaded once for the whole burst.
+ * Packets are handed to processors in chunks of PACKET_BURST_MAX.
+ *
+ * @param pkts Packets to process
+ * @param count Number of packets
+ * @param results Final processing result for each packet
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t packet_process_burst(packet_buffer_t **pkts, uint32_t count, packet_result_t *results) {
+    if (!g_initialized) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Packet processing subsystem not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (!pkts || !results) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Invalid parameters for packet_process_burst");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (count == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    if (rcu_read_lock() != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to register packet processing thread");
+        // The caller drops the whole burst
+        packet_drop_count_burst(pkts, 0, count, PACKET_DROP_INTERNAL);
+        return STATUS_NO_MEMORY;
+    }
+    const processor_table_t *table = __atomic_load_n(&g_active_table, __ATOMIC_SEQ_CST);
+
+    uint32_t processor_count = table ? table->count : 0;
+    const packet_processor_t *processors = table ? table->entries : NULL;
+
+    for (uint32_t base = 0; base < count; base += PACKET_BURST_MAX) {
+        uint32_t n = count - base < PACKET_BURST_MAX ? count - base : PACKET_BURST_MAX;
+        packet_process_chunk(pkts + base, n, results + base, processors, processor_count);
+    }
+
+    rcu_read_unlock();
+
+    LOG_DEBUG(LOG_CATEGORY_HAL, "Processed burst of %u packets", count);
+    return STATUS_SUCCESS;
+}
+
 /**
  * @brief Inject a packet into the processing pipeline
  *
@@ -1101,13 +2591,12 @@ status_t packet_handle_incoming(packet_buffer_t *packet) {
         return STATUS_INVALID_PARAMETER;
     }
 
-    // Determine source port ID
-    port_id_t port_id;
-    status_t status = hw_sim_receive_packet(packet, &port_id);
-    if (status != STATUS_SUCCESS) {
+    // Source port is recorded by the hardware simulation on reception
+    port_id_t port_id = packet->metadata.port;
+    if (port_id == PORT_ID_INVALID) {
         LOG_ERROR(LOG_CATEGORY_HAL, "Failed to determine source port for incoming packet: %s",
-                 error_to_string(status));
-        return status;
+                 error_to_string(STATUS_INVALID_PARAMETER));
+        return STATUS_INVALID_PARAMETER;
     }
 
     // Process packet as a received packet
@@ -1214,6 +2703,11 @@ status_t packet_set_header(packet_buffer_t *packet, uint32_t offset, const void
         return STATUS_OUT_OF_BOUNDS;
     }
 
+    status_t cow = packet_make_writable(packet);
+    if (cow != STATUS_SUCCESS) {
+        return cow;
+    }
+
     // Copy header data
     memcpy(packet->data + offset, header, size);
 
@@ -1245,11 +2739,24 @@ status_t packet_insert(packet_buffer_t *packet, uint32_t offset, const void *dat
     }
 
     // Check if offset is valid
-    if (offset > packet->size) {
-        LOG_ERROR(LOG_CATEGORY_HAL, "Insert offset %u exceeds packet size %u", offset, packet->size);
+    if (offset > packet_chain_length(packet)) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Insert offset %u exceeds packet size %u", offset, packet_chain_length(packet));
         return STATUS_OUT_OF_BOUNDS;
     }
 
+    // Middle edits work on one contiguous buffer
+    if (packet->next) {
+        status_t lin = packet_linearize(packet);
+        if (lin != STATUS_SUCCESS) {
+            return lin;
+        }
+    }
+
+    status_t cow = packet_make_writable(packet);
+    if (cow != STATUS_SUCCESS) {
+        return cow;
+    }
+
     // Calculate new size and check capacity
     uint32_t new_size = packet->size + size;
     if (new_size > packet->capacity) {
@@ -1298,12 +2805,25 @@ status_t packet_remove(packet_buffer_t *packet, uint32_t offset, uint32_t size)
     }
 
     // Check if requested removal is within packet boundaries
-    if (offset + size > packet->size) {
+    if (offset + size > packet_chain_length(packet)) {
         LOG_ERROR(LOG_CATEGORY_HAL, "Removal range [%u-%u] exceeds packet size %u",
-                 offset, offset + size - 1, packet->size);
+                 offset, offset + size - 1, packet_chain_length(packet));
         return STATUS_OUT_OF_BOUNDS;
     }
 
+    // Middle edits work on one contiguous buffer
+    if (packet->next) {
+        status_t lin = packet_linearize(packet);
+        if (lin != STATUS_SUCCESS) {
+            return lin;
+        }
+    }
+
+    status_t cow = packet_make_writable(packet);
+    if (cow != STATUS_SUCCESS) {
+        return cow;
+    }
+
     // Shift data to close the gap
     if (offset + size < packet->size) {
         memmove(packet->data + offset, packet->data + offset + size, packet->size - (offset + size));
@@ -1316,6 +2836,1021 @@ status_t packet_remove(packet_buffer_t *packet, uint32_t offset, uint32_t size)
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Size of the destination and source MAC addresses at frame start
+ */
+#define PACKET_ETH_ADDRS_LEN    (2 * MAC_ADDR_LEN)
+
+/**
+ * @brief Size of an 802.1Q/802.1ad tag
+ */
+#define PACKET_VLAN_TAG_LEN     4
+
+/**
+ * @brief Read a big-endian 16-bit value from packet data
+ */
+static inline uint16_t packet_read_be16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+/**
+ * @brief Write a big-endian 16-bit value to packet data
+ */
+static inline void packet_write_be16(uint8_t *p, uint16_t value) {
+    p[0] = (uint8_t)(value >> 8);
+    p[1] = (uint8_t)(value & 0xFF);
+}
+
+/**
+ * @brief IP protocol numbers recognized by the header parser
+ */
+#define PACKET_IPPROTO_HOPOPTS  0
+#define PACKET_IPPROTO_ICMP     1
+#define PACKET_IPPROTO_TCP      6
+#define PACKET_IPPROTO_UDP      17
+#define PACKET_IPPROTO_ROUTING  43
+#define PACKET_IPPROTO_FRAGMENT 44
+#define PACKET_IPPROTO_AH       51
+#define PACKET_IPPROTO_ICMPV6   58
+#define PACKET_IPPROTO_DSTOPTS  60
+
+/* Echo types, whose identifier pairs a request with its reply */
+#define PACKET_ICMP_ECHO_REPLY      0
+#define PACKET_ICMP_ECHO_REQUEST    8
+#define PACKET_ICMPV6_ECHO_REQUEST  128
+#define PACKET_ICMPV6_ECHO_REPLY    129
+
+/**
+ * @brief Fixed header sizes used by the header parser
+ */
+#define PACKET_ETH_HDR_LEN      14
+#define PACKET_IPV4_MIN_HDR_LEN 20
+#define PACKET_IPV6_HDR_LEN     40
+
+/**
+ * @brief Record the transport protocol of a parsed packet
+ */
+static inline void packet_parse_l4(packet_metadata_t *md, uint8_t proto, uint32_t offset) {
+    md->l4_proto = proto;
+    md->l4_offset = (uint16_t)offset;
+    md->parsed |= PACKET_PARSED_L4;
+
+    switch (proto) {
+        case PACKET_IPPROTO_TCP:    md->proto_flags |= PACKET_PROTO_TCP; break;
+        case PACKET_IPPROTO_UDP:    md->proto_flags |= PACKET_PROTO_UDP; break;
+        case PACKET_IPPROTO_ICMP:
+        case PACKET_IPPROTO_ICMPV6: md->proto_flags |= PACKET_PROTO_ICMP; break;
+        default: break;
+    }
+}
+
+/**
+ * @brief Parse an IPv4 header at offset
+ */
+static void packet_parse_ipv4(const uint8_t *data, uint32_t size, uint32_t offset,
+                              packet_metadata_t *md) {
+    if (size - offset < PACKET_IPV4_MIN_HDR_LEN || (data[offset] >> 4) != 4) {
+        return;
+    }
+
+    uint32_t ihl = (uint32_t)(data[offset] & 0x0F) * 4;
+    if (ihl < PACKET_IPV4_MIN_HDR_LEN || size - offset < ihl) {
+        return;
+    }
+
+    md->proto_flags |= PACKET_PROTO_IPV4;
+    md->parsed |= PACKET_PARSED_L3;
+    if (ihl > PACKET_IPV4_MIN_HDR_LEN) {
+        md->proto_flags |= PACKET_PROTO_IP_OPTIONS;
+    }
+
+    uint16_t frag = packet_read_be16(data + offset + 6);
+    if (frag & 0x3FFF) {
+        md->proto_flags |= PACKET_PROTO_IP_FRAG;
+        // Only the first fragment carries the transport header
+        if (frag & 0x1FFF) {
+            md->l4_proto = data[offset + 9];
+            return;
+        }
+    }
+
+    packet_parse_l4(md, data[offset + 9], offset + ihl);
+}
+
+/**
+ * @brief Parse an IPv6 header and its extension header chain at offset
+ */
+static void packet_parse_ipv6(const uint8_t *data, uint32_t size, uint32_t offset,
+                              packet_metadata_t *md) {
+    if (size - offset < PACKET_IPV6_HDR_LEN || (data[offset] >> 4) != 6) {
+        return;
+    }
+
+    md->proto_flags |= PACKET_PROTO_IPV6;
+    md->parsed |= PACKET_PARSED_L3;
+
+    uint8_t next = data[offset + 6];
+    uint32_t pos = offset + PACKET_IPV6_HDR_LEN;
+
+    for (;;) {
+        uint32_t ext_len;
+
+        switch (next) {
+            case PACKET_IPPROTO_ROUTING:
+                md->proto_flags |= PACKET_PROTO_IPV6_ROUTING;
+                // fall through
+            case PACKET_IPPROTO_HOPOPTS:
+            case PACKET_IPPROTO_DSTOPTS:
+                if (size - pos < 8) {
+                    return;
+                }
+                ext_len = ((uint32_t)data[pos + 1] + 1) * 8;
+                break;
+
+            case PACKET_IPPROTO_AH:
+                // Length in 4-octet units, minus two
+                if (size - pos < 8) {
+                    return;
+                }
+                ext_len = ((uint32_t)data[pos + 1] + 2) * 4;
+                break;
+
+            case PACKET_IPPROTO_FRAGMENT:
+                if (size - pos < 8) {
+                    return;
+                }
+                md->proto_flags |= PACKET_PROTO_IP_FRAG;
+                if (packet_read_be16(data + pos + 2) & 0xFFF8) {
+                    // Non-first fragment: no transport header here
+                    md->proto_flags |= PACKET_PROTO_IP_OPTIONS;
+                    md->l4_proto = data[pos];
+                    return;
+                }
+                ext_len = 8;
+                break;
+
+            default:
+                packet_parse_l4(md, next, pos);
+                return;
+        }
+
+        if (size - pos < ext_len) {
+            return;
+        }
+        md->proto_flags |= PACKET_PROTO_IP_OPTIONS;
+        next = data[pos];
+        pos += ext_len;
+    }
+}
+
+/**
+ * @brief Size of an MPLS label stack entry
+ */
+#define PACKET_MPLS_LSE_LEN     4
 
+/**
+ * @brief Walk an MPLS label stack at offset
+ *
+ * Entries beyond PACKET_MAX_MPLS_LABELS are counted but not recorded.
+ */
+static void packet_parse_mpls(const uint8_t *data, uint32_t size, uint32_t offset,
+                              packet_metadata_t *md) {
+    md->proto_flags |= PACKET_PROTO_MPLS;
+
+    while (size - offset >= PACKET_MPLS_LSE_LEN) {
+        uint32_t lse = (uint32_t)packet_read_be16(data + offset) << 16 | packet_read_be16(data + offset + 2);
+        if (md->mpls_count < PACKET_MAX_MPLS_LABELS) {
+            md->mpls_stack[md->mpls_count] = lse;
+        }
+        if (md->mpls_count == UINT8_MAX) {
+            return;
+        }
+        md->mpls_count++;
+        offset += PACKET_MPLS_LSE_LEN;
+        if (lse & 0x100) {
+            md->parsed |= PACKET_PARSED_MPLS;
+            return;
+        }
+    }
+}
 
+/**
+ * @brief Parse packet headers once and cache the result in metadata
+ *
+ * @param packet Packet buffer
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PACKET if the frame is
+ *         shorter than an Ethernet header
+ */
+status_t packet_parse(packet_buffer_t *packet) {
+    if (!packet_buffer_is_valid(packet)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    packet_metadata_t *md = &packet->metadata;
+    const uint8_t *data = packet->data;
+    uint32_t size = packet->size;
+
+    md->parsed = PACKET_PARSED_DONE;
+    md->proto_flags = 0;
+    md->vlan_count = 0;
+    md->l3_offset = 0;
+    md->l4_offset = 0;
+    md->l4_proto = 0;
+    md->mpls_count = 0;
 
+    if (size < PACKET_ETH_HDR_LEN) {
+        return STATUS_INVALID_PACKET;
+    }
+
+    memcpy(md->dst_mac.addr, data, MAC_ADDR_LEN);
+    memcpy(md->src_mac.addr, data + MAC_ADDR_LEN, MAC_ADDR_LEN);
+    if (data[0] & 0x01) {
+        static const uint8_t bcast[MAC_ADDR_LEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+        md->proto_flags |= memcmp(data, bcast, MAC_ADDR_LEN) == 0 ?
+                           PACKET_PROTO_L2_BCAST : PACKET_PROTO_L2_MCAST;
+    }
+
+    // Walk the VLAN stack; tags beyond PACKET_MAX_VLAN_TAGS are skipped
+    uint32_t offset = PACKET_ETH_ADDRS_LEN;
+    uint16_t ethertype = packet_read_be16(data + offset);
+    while (ethertype == ETHERTYPE_VLAN || ethertype == ETHERTYPE_QINQ) {
+        if (size - offset < PACKET_VLAN_TAG_LEN + 2) {
+            return STATUS_SUCCESS;
+        }
+        if (md->vlan_count < PACKET_MAX_VLAN_TAGS) {
+            md->vlan_tpid[md->vlan_count] = ethertype;
+            md->vlan_tci[md->vlan_count] = packet_read_be16(data + offset + 2);
+        }
+        if (md->vlan_count < UINT8_MAX) {
+            md->vlan_count++;
+        }
+        offset += PACKET_VLAN_TAG_LEN;
+        ethertype = packet_read_be16(data + offset);
+    }
+
+    offset += 2;
+    md->ethertype = ethertype;
+    md->l3_offset = (uint16_t)offset;
+    md->parsed |= PACKET_PARSED_L2;
+
+    if (md->vlan_count > 0) {
+        md->proto_flags |= PACKET_PROTO_VLAN;
+        md->is_tagged = true;
+        md->vlan = md->vlan_tci[0] & 0x0FFF;
+        md->priority = (uint8_t)(md->vlan_tci[0] >> 13);
+        if (md->vlan_count > 1) {
+            md->proto_flags |= PACKET_PROTO_QINQ;
+        }
+    } else {
+        md->is_tagged = false;
+    }
+
+    switch (ethertype) {
+        case ETHERTYPE_IP:
+            packet_parse_ipv4(data, size, offset, md);
+            break;
+        case ETHERTYPE_IPV6:
+            packet_parse_ipv6(data, size, offset, md);
+            break;
+        case ETHERTYPE_ARP:
+            md->proto_flags |= PACKET_PROTO_ARP;
+            break;
+        case ETHERTYPE_MPLS:
+        case ETHERTYPE_MPLS_MC:
+            packet_parse_mpls(data, size, offset, md);
+            break;
+        default:
+            break;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Feed bytes into a running FNV-1a hash
+ */
+static inline uint32_t packet_hash_bytes(uint32_t hash, const uint8_t *p, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Feed the endpoints of an IP flow into a running hash
+ *
+ * The endpoint with the lower address, or the lower port on equal
+ * addresses, goes first, so that both directions of a flow hash alike.
+ *
+ * @param hash Running hash
+ * @param src Source address
+ * @param dst Destination address
+ * @param addr_len Address length, 4 or 16
+ * @param protocol IPv4 protocol or IPv6 next header
+ * @param ports Source and destination port (4 bytes), an ICMP echo
+ *        identifier (2 bytes) or nothing
+ * @param ports_len 4, 2 or 0
+ * @return Running hash
+ */
+static uint32_t packet_hash_endpoints(uint32_t hash, const uint8_t *src, const uint8_t *dst, uint32_t addr_len,
+                                      uint8_t protocol, const uint8_t *ports, uint32_t ports_len) {
+    int order = memcmp(src, dst, addr_len);
+
+    if (order == 0 && ports_len == 4) {
+        order = memcmp(ports, ports + 2, 2);
+    }
+    if (order > 0) {
+        hash = packet_hash_bytes(hash, dst, addr_len);
+        hash = packet_hash_bytes(hash, src, addr_len);
+    } else {
+        hash = packet_hash_bytes(hash, src, addr_len);
+        hash = packet_hash_bytes(hash, dst, addr_len);
+    }
+    hash = packet_hash_bytes(hash, &protocol, 1);
+
+    if (ports_len == 4 && order > 0) {
+        hash = packet_hash_bytes(hash, ports + 2, 2);
+        hash = packet_hash_bytes(hash, ports, 2);
+    } else {
+        hash = packet_hash_bytes(hash, ports, ports_len);
+    }
+    return hash;
+}
+
+/**
+ * @brief Final avalanche so that low bits are usable for modulo dispatch
+ */
+static inline uint32_t packet_hash_finish(uint32_t hash) {
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/**
+ * @brief Flow hash of an IPv4 packet with the given header fields
+ *
+ * @param src Source address, network order
+ * @param dst Destination address, network order
+ * @param protocol IPv4 protocol
+ * @param src_port TCP or UDP source port, or ICMP echo identifier, network order
+ * @param dst_port TCP or UDP destination port, network order
+ * @return The hash packet_flow_hash() gives such a packet
+ */
+uint32_t packet_flow_hash_ipv4(ipv4_addr_t src, ipv4_addr_t dst, uint8_t protocol,
+                               uint16_t src_port, uint16_t dst_port) {
+    uint8_t ports[4];
+    uint32_t ports_len = 0;
+
+    memcpy(ports, &src_port, 2);
+    memcpy(ports + 2, &dst_port, 2);
+    if (protocol == PACKET_IPPROTO_TCP || protocol == PACKET_IPPROTO_UDP) {
+        ports_len = 4;
+    } else if (protocol == PACKET_IPPROTO_ICMP) {
+        ports_len = 2;
+    }
+    return packet_hash_finish(packet_hash_endpoints(2166136261u, (const uint8_t *)&src, (const uint8_t *)&dst,
+                                                    4, protocol, ports, ports_len));
+}
+
+/**
+ * @brief Get the flow hash of a packet
+ *
+ * @param packet Packet buffer
+ * @return Flow hash (0 for invalid packets)
+ */
+uint32_t packet_flow_hash(packet_buffer_t *packet) {
+    if (!packet_buffer_is_valid(packet)) {
+        return 0;
+    }
+    if (packet_parsed_has(packet, PACKET_PARSED_HASH)) {
+        return packet->metadata.flow_hash;
+    }
+
+    packet_ensure_parsed(packet);
+
+    const packet_metadata_t *md = &packet->metadata;
+    const uint8_t *data = packet->data;
+    uint32_t hash = 2166136261u;
+
+    if (packet_parsed_has(packet, PACKET_PARSED_L3)) {
+        const uint8_t *l3 = packet_l3_header(packet);
+        const uint8_t *l4 = packet_l4_header(packet);
+        bool ipv4 = packet_has_proto(packet, PACKET_PROTO_IPV4);
+        uint32_t ports_len = 0;
+
+        // Ports, or the identifier that pairs an echo with its reply
+        if (!packet_has_proto(packet, PACKET_PROTO_IP_FRAG)) {
+            if (packet_has_proto(packet, PACKET_PROTO_TCP | PACKET_PROTO_UDP) &&
+                packet->size >= (uint32_t)md->l4_offset + 4) {
+                ports_len = 4;
+            } else if (packet_has_proto(packet, PACKET_PROTO_ICMP) &&
+                       packet->size >= (uint32_t)md->l4_offset + 6 &&
+                       (ipv4 ? (l4[0] == PACKET_ICMP_ECHO_REQUEST || l4[0] == PACKET_ICMP_ECHO_REPLY)
+                             : (l4[0] == PACKET_ICMPV6_ECHO_REQUEST || l4[0] == PACKET_ICMPV6_ECHO_REPLY))) {
+                ports_len = 2;
+                l4 += 4;
+            }
+        }
+
+        if (ipv4) {
+            hash = packet_hash_endpoints(hash, l3 + 12, l3 + 16, 4, l3[9], l4, ports_len);
+        } else {
+            hash = packet_hash_endpoints(hash, l3 + 8, l3 + 24, 16, md->l4_proto, l4, ports_len);
+        }
+    } else if (packet_has_proto(packet, PACKET_PROTO_MPLS)) {
+        // Labels without TTL and TC, then the addresses of an IP payload
+        uint32_t count = md->mpls_count < PACKET_MAX_MPLS_LABELS ? md->mpls_count : PACKET_MAX_MPLS_LABELS;
+        for (uint32_t i = 0; i < count; i++) {
+            uint8_t label[3] = {
+                (uint8_t)(md->mpls_stack[i] >> 24), (uint8_t)(md->mpls_stack[i] >> 16),
+                (uint8_t)((md->mpls_stack[i] >> 8) & 0xF0)
+            };
+            hash = packet_hash_bytes(hash, label, sizeof(label));
+        }
+        if (packet_parsed_has(packet, PACKET_PARSED_MPLS)) {
+            uint32_t payload = (uint32_t)md->l3_offset + (uint32_t)md->mpls_count * PACKET_MPLS_LSE_LEN;
+            uint32_t left = packet->size - payload;
+            if (left >= PACKET_IPV4_MIN_HDR_LEN && (data[payload] >> 4) == 4) {
+                hash = packet_hash_bytes(hash, data + payload + 12, 8);
+            } else if (left >= PACKET_IPV6_HDR_LEN && (data[payload] >> 4) == 6) {
+                hash = packet_hash_bytes(hash, data + payload + 8, 32);
+            }
+        }
+    } else if (packet->size >= PACKET_ETH_HDR_LEN) {
+        uint16_t vid = md->vlan_count ? (md->vlan_tci[0] & 0x0FFF) : 0;
+        uint8_t extra[4] = {
+            (uint8_t)(md->ethertype >> 8), (uint8_t)md->ethertype,
+            (uint8_t)(vid >> 8), (uint8_t)vid
+        };
+        hash = packet_hash_bytes(hash, data, PACKET_ETH_ADDRS_LEN);
+        hash = packet_hash_bytes(hash, extra, sizeof(extra));
+    }
+
+    hash = packet_hash_finish(hash);
+
+    packet->metadata.flow_hash = hash;
+    packet->metadata.parsed |= PACKET_PARSED_HASH;
+    return hash;
+}
+
+/**
+ * @brief Prepend space for a header in front of packet data
+ *
+ * With enough headroom this only moves the data pointer back. Otherwise
+ * the payload is shifted towards the tail, growing the buffer if the
+ * tailroom is too small as well.
+ *
+ * @param packet Packet buffer
+ * @param length Number of bytes to prepend
+ * @param header_out Start of the new header space (may be NULL)
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t packet_push_header(packet_buffer_t *packet, uint32_t length, uint8_t **header_out) {
+    if (!packet_buffer_is_valid(packet) || length == 0) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Invalid parameters for packet_push_header");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    status_t cow = packet_make_writable(packet);
+    if (cow != STATUS_SUCCESS) {
+        return cow;
+    }
+
+    if (packet_headroom(packet) >= length) {
+        packet->data -= length;
+        packet->capacity += length;
+        packet->size += length;
+    } else {
+        // Slow path: no headroom left, shift the payload
+        uint32_t old_size = packet->size;
+        if (packet_tailroom(packet) < length) {
+            status_t status = packet_buffer_resize(packet, old_size + length);
+            if (status != STATUS_SUCCESS) {
+                return status;
+            }
+        }
+        memmove(packet->data + length, packet->data, old_size);
+        packet->size = old_size + length;
+        LOG_DEBUG(LOG_CATEGORY_HAL, "No headroom for %u byte header, payload shifted", length);
+    }
+
+    if (header_out) {
+        *header_out = packet->data;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Strip a header from the front of packet data
+ *
+ * @param packet Packet buffer
+ * @param length Number of bytes to strip
+ * @param header_out Start of the removed header (may be NULL)
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t packet_pull_header(packet_buffer_t *packet, uint32_t length, uint8_t **header_out) {
+    if (!packet_buffer_is_valid(packet) || length == 0) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Invalid parameters for packet_pull_header");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (length > packet->size) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Cannot pull %u bytes from packet of size %u",
+                  length, packet->size);
+        return STATUS_OUT_OF_BOUNDS;
+    }
+
+    packet_invalidate_parse(packet);
+
+    if (header_out) {
+        *header_out = packet->data;
+    }
+    packet->data += length;
+    packet->capacity -= length;
+    packet->size -= length;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Record a pushed VLAN tag in the header cache
+ *
+ * Shifts the cached VLAN stack and offsets instead of dropping the cache,
+ * so a frame parsed once at ingress stays parsed through tag rewrites.
+ * Falls back to invalidation (keeping the flow hash) when the stack no
+ * longer fits in metadata.
+ *
+ * @param md Packet metadata
+ * @param tpid TPID of the new outermost tag
+ * @param tci TCI of the new outermost tag
+ */
+static void packet_vlan_cache_push(packet_metadata_t *md, uint16_t tpid, uint16_t tci) {
+    if (!(md->parsed & PACKET_PARSED_L2) || md->vlan_count >= PACKET_MAX_VLAN_TAGS) {
+        md->parsed &= PACKET_PARSED_HASH;
+        return;
+    }
+
+    for (uint32_t i = md->vlan_count; i > 0; i--) {
+        md->vlan_tpid[i] = md->vlan_tpid[i - 1];
+        md->vlan_tci[i] = md->vlan_tci[i - 1];
+    }
+    md->vlan_tpid[0] = tpid;
+    md->vlan_tci[0] = tci;
+    md->vlan_count++;
+    md->l3_offset += PACKET_VLAN_TAG_LEN;
+    if (md->parsed & PACKET_PARSED_L4) {
+        md->l4_offset += PACKET_VLAN_TAG_LEN;
+    }
+    md->proto_flags |= PACKET_PROTO_VLAN;
+    if (md->vlan_count > 1) {
+        md->proto_flags |= PACKET_PROTO_QINQ;
+    }
+    md->priority = (uint8_t)(tci >> 13);
+}
+
+/**
+ * @brief Record a popped VLAN tag in the header cache
+ *
+ * @param md Packet metadata
+ */
+static void packet_vlan_cache_pop(packet_metadata_t *md) {
+    if (!(md->parsed & PACKET_PARSED_L2) || md->vlan_count == 0 ||
+        md->vlan_count > PACKET_MAX_VLAN_TAGS) {
+        md->parsed &= PACKET_PARSED_HASH;
+        return;
+    }
+
+    md->vlan_count--;
+    for (uint32_t i = 0; i < md->vlan_count; i++) {
+        md->vlan_tpid[i] = md->vlan_tpid[i + 1];
+        md->vlan_tci[i] = md->vlan_tci[i + 1];
+    }
+    md->l3_offset -= PACKET_VLAN_TAG_LEN;
+    if (md->parsed & PACKET_PARSED_L4) {
+        md->l4_offset -= PACKET_VLAN_TAG_LEN;
+    }
+    if (md->vlan_count < 2) {
+        md->proto_flags &= (uint16_t)~PACKET_PROTO_QINQ;
+    }
+    if (md->vlan_count == 0) {
+        md->proto_flags &= (uint16_t)~PACKET_PROTO_VLAN;
+    } else {
+        md->priority = (uint8_t)(md->vlan_tci[0] >> 13);
+    }
+}
+
+/**
+ * @brief Insert an 802.1Q/802.1ad tag after the MAC addresses in place
+ *
+ * The tag is pushed into headroom and only the 12 address bytes are moved.
+ *
+ * @param packet Packet buffer
+ * @param tpid Tag protocol identifier
+ * @param tci Tag control information
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t packet_vlan_push(packet_buffer_t *packet, uint16_t tpid, uint16_t tci) {
+    if (!packet_buffer_is_valid(packet) || packet->size < PACKET_ETH_ADDRS_LEN) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Invalid packet for VLAN tag push");
+        return STATUS_INVALID_PACKET;
+    }
+
+    // make_writable() drops the header cache; it is restored and shifted below
+    uint16_t parsed = packet->metadata.parsed;
+    uint8_t *frame;
+    status_t status = packet_push_header(packet, PACKET_VLAN_TAG_LEN, &frame);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    packet->metadata.parsed = parsed;
+
+    memmove(frame, frame + PACKET_VLAN_TAG_LEN, PACKET_ETH_ADDRS_LEN);
+    packet_write_be16(frame + PACKET_ETH_ADDRS_LEN, tpid);
+    packet_write_be16(frame + PACKET_ETH_ADDRS_LEN + 2, tci);
+
+    packet_vlan_cache_push(&packet->metadata, tpid, tci);
+    packet->metadata.is_tagged = true;
+    packet->metadata.vlan = tci & 0x0FFF;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Remove the outermost 802.1Q/802.1ad tag in place
+ *
+ * @param packet Packet buffer
+ * @param tci_out Removed tag control information (may be NULL)
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if the frame is untagged
+ */
+status_t packet_vlan_pop(packet_buffer_t *packet, uint16_t *tci_out) {
+    if (!packet_buffer_is_valid(packet) ||
+        packet->size < PACKET_ETH_ADDRS_LEN + PACKET_VLAN_TAG_LEN + 2) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Invalid packet for VLAN tag pop");
+        return STATUS_INVALID_PACKET;
+    }
+
+    uint16_t tpid = packet_read_be16(packet->data + PACKET_ETH_ADDRS_LEN);
+    if (tpid != ETHERTYPE_VLAN && tpid != ETHERTYPE_QINQ) {
+        return STATUS_NOT_FOUND;
+    }
+
+    // make_writable() drops the header cache; it is restored and shifted below
+    uint16_t parsed = packet->metadata.parsed;
+    status_t cow = packet_make_writable(packet);
+    if (cow != STATUS_SUCCESS) {
+        return cow;
+    }
+
+    uint8_t *frame = packet->data;
+    uint16_t tci = packet_read_be16(frame + PACKET_ETH_ADDRS_LEN + 2);
+    memmove(frame + PACKET_VLAN_TAG_LEN, frame, PACKET_ETH_ADDRS_LEN);
+    packet_pull_header(packet, PACKET_VLAN_TAG_LEN, NULL);
+    packet->metadata.parsed = parsed;
+    packet_vlan_cache_pop(&packet->metadata);
+
+    // An inner tag may still be present after popping an S-tag
+    uint16_t inner = packet_read_be16(packet->data + PACKET_ETH_ADDRS_LEN);
+    packet->metadata.is_tagged = (inner == ETHERTYPE_VLAN || inner == ETHERTYPE_QINQ);
+    packet->metadata.vlan = packet->metadata.is_tagged ?
+        (packet_read_be16(packet->data + PACKET_ETH_ADDRS_LEN + 2) & 0x0FFF) : 0;
+
+    if (tci_out) {
+        *tci_out = tci;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the TPID of the outermost VLAN tag
+ *
+ * @param packet Packet buffer
+ * @return TPID of the outer tag, or 0 if the frame is untagged
+ */
+uint16_t packet_vlan_tpid(const packet_buffer_t *packet) {
+    if (!packet) {
+        return 0;
+    }
+
+    if (packet_parsed_has(packet, PACKET_PARSED_L2)) {
+        return packet->metadata.vlan_count > 0 ? packet->metadata.vlan_tpid[0] : 0;
+    }
+
+    if (!packet->data || packet->size < PACKET_ETH_ADDRS_LEN + PACKET_VLAN_TAG_LEN) {
+        return 0;
+    }
+
+    uint16_t tpid = packet_read_be16(packet->data + PACKET_ETH_ADDRS_LEN);
+    return (tpid == ETHERTYPE_VLAN || tpid == ETHERTYPE_QINQ) ? tpid : 0;
+}
+
+/**
+ * @brief Replace the TPID of the outermost VLAN tag in place
+ *
+ * @param packet Packet buffer
+ * @param tpid New tag protocol identifier
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if the frame is untagged
+ */
+status_t packet_vlan_set_tpid(packet_buffer_t *packet, uint16_t tpid) {
+    if (!packet_buffer_is_valid(packet) ||
+        packet->size < PACKET_ETH_ADDRS_LEN + PACKET_VLAN_TAG_LEN) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Invalid packet for VLAN TPID rewrite");
+        return STATUS_INVALID_PACKET;
+    }
+
+    uint16_t old = packet_read_be16(packet->data + PACKET_ETH_ADDRS_LEN);
+    if (old != ETHERTYPE_VLAN && old != ETHERTYPE_QINQ) {
+        return STATUS_NOT_FOUND;
+    }
+    if (old == tpid) {
+        return STATUS_SUCCESS;
+    }
+
+    // Offsets do not move, so the header cache survives make_writable()
+    uint16_t parsed = packet->metadata.parsed;
+    status_t cow = packet_make_writable(packet);
+    if (cow != STATUS_SUCCESS) {
+        return cow;
+    }
+    packet->metadata.parsed = parsed;
+
+    packet_write_be16(packet->data + PACKET_ETH_ADDRS_LEN, tpid);
+    if (packet_parsed_has(packet, PACKET_PARSED_L2) && packet->metadata.vlan_count > 0) {
+        packet->metadata.vlan_tpid[0] = tpid;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Insert an 802.1ad S-tag and 802.1Q C-tag after the MAC addresses in place
+ *
+ * Both tags go into headroom in one step, so the address bytes are moved
+ * once rather than once per tag.
+ *
+ * @param packet Packet buffer
+ * @param s_tci Service tag control information
+ * @param c_tci Customer tag control information
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t packet_qinq_push(packet_buffer_t *packet, uint16_t s_tci, uint16_t c_tci) {
+    if (!packet_buffer_is_valid(packet) || packet->size < PACKET_ETH_ADDRS_LEN) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Invalid packet for QinQ tag push");
+        return STATUS_INVALID_PACKET;
+    }
+
+    uint16_t parsed = packet->metadata.parsed;
+    uint8_t *frame;
+    status_t status = packet_push_header(packet, 2 * PACKET_VLAN_TAG_LEN, &frame);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    packet->metadata.parsed = parsed;
+
+    memmove(frame, frame + 2 * PACKET_VLAN_TAG_LEN, PACKET_ETH_ADDRS_LEN);
+    packet_write_be16(frame + PACKET_ETH_ADDRS_LEN, ETHERTYPE_QINQ);
+    packet_write_be16(frame + PACKET_ETH_ADDRS_LEN + 2, s_tci);
+    packet_write_be16(frame + PACKET_ETH_ADDRS_LEN + 4, ETHERTYPE_VLAN);
+    packet_write_be16(frame + PACKET_ETH_ADDRS_LEN + 6, c_tci);
+
+    packet_vlan_cache_push(&packet->metadata, ETHERTYPE_VLAN, c_tci);
+    packet_vlan_cache_push(&packet->metadata, ETHERTYPE_QINQ, s_tci);
+    packet->metadata.is_tagged = true;
+    packet->metadata.vlan = s_tci & 0x0FFF;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Remove the two outermost VLAN tags in place
+ *
+ * @param packet Packet buffer
+ * @param[out] s_tci_out Removed outer tag control information (may be NULL)
+ * @param[out] c_tci_out Removed inner tag control information (may be NULL)
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if the frame is not double tagged
+ */
+status_t packet_qinq_pop(packet_buffer_t *packet, uint16_t *s_tci_out, uint16_t *c_tci_out) {
+    if (!packet_buffer_is_valid(packet) ||
+        packet->size < PACKET_ETH_ADDRS_LEN + 2 * PACKET_VLAN_TAG_LEN + 2) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Invalid packet for QinQ tag pop");
+        return STATUS_INVALID_PACKET;
+    }
+
+    const uint8_t *tags = packet->data + PACKET_ETH_ADDRS_LEN;
+    uint16_t outer = packet_read_be16(tags);
+    uint16_t inner = packet_read_be16(tags + PACKET_VLAN_TAG_LEN);
+    if ((outer != ETHERTYPE_VLAN && outer != ETHERTYPE_QINQ) ||
+        (inner != ETHERTYPE_VLAN && inner != ETHERTYPE_QINQ)) {
+        return STATUS_NOT_FOUND;
+    }
+
+    uint16_t parsed = packet->metadata.parsed;
+    status_t cow = packet_make_writable(packet);
+    if (cow != STATUS_SUCCESS) {
+        return cow;
+    }
+
+    uint8_t *frame = packet->data;
+    uint16_t s_tci = packet_read_be16(frame + PACKET_ETH_ADDRS_LEN + 2);
+    uint16_t c_tci = packet_read_be16(frame + PACKET_ETH_ADDRS_LEN + 6);
+    memmove(frame + 2 * PACKET_VLAN_TAG_LEN, frame, PACKET_ETH_ADDRS_LEN);
+    packet_pull_header(packet, 2 * PACKET_VLAN_TAG_LEN, NULL);
+    packet->metadata.parsed = parsed;
+    packet_vlan_cache_pop(&packet->metadata);
+    packet_vlan_cache_pop(&packet->metadata);
+
+    uint16_t next = packet_read_be16(packet->data + PACKET_ETH_ADDRS_LEN);
+    packet->metadata.is_tagged = (next == ETHERTYPE_VLAN || next == ETHERTYPE_QINQ);
+    packet->metadata.vlan = packet->metadata.is_tagged ?
+        (packet_read_be16(packet->data + PACKET_ETH_ADDRS_LEN + 2) & 0x0FFF) : 0;
+
+    if (s_tci_out) {
+        *s_tci_out = s_tci;
+    }
+    if (c_tci_out) {
+        *c_tci_out = c_tci;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Replace the VID of the outermost VLAN tag in place
+ *
+ * PCP and DEI bits are kept.
+ *
+ * @param packet Packet buffer
+ * @param vlan_id New VLAN ID
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if the frame is untagged
+ */
+status_t packet_vlan_set_vid(packet_buffer_t *packet, vlan_id_t vlan_id) {
+    if (!packet_buffer_is_valid(packet) ||
+        packet->size < PACKET_ETH_ADDRS_LEN + PACKET_VLAN_TAG_LEN) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Invalid packet for VLAN tag rewrite");
+        return STATUS_INVALID_PACKET;
+    }
+
+    uint16_t tpid = packet_read_be16(packet->data + PACKET_ETH_ADDRS_LEN);
+    if (tpid != ETHERTYPE_VLAN && tpid != ETHERTYPE_QINQ) {
+        return STATUS_NOT_FOUND;
+    }
+
+    // Only the VID changes, so the header cache survives make_writable()
+    uint16_t parsed = packet->metadata.parsed;
+    status_t cow = packet_make_writable(packet);
+    if (cow != STATUS_SUCCESS) {
+        return cow;
+    }
+    packet->metadata.parsed = parsed;
+
+    uint8_t *tci = packet->data + PACKET_ETH_ADDRS_LEN + 2;
+    uint16_t value = (uint16_t)((packet_read_be16(tci) & 0xF000) | (vlan_id & 0x0FFF));
+    packet_write_be16(tci, value);
+
+    packet->metadata.vlan = vlan_id & 0x0FFF;
+    if (packet_parsed_has(packet, PACKET_PARSED_L2) && packet->metadata.vlan_count > 0) {
+        packet->metadata.vlan_tci[0] = value;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Check if a packet has a VLAN tag
+ *
+ * @param packet Packet to check
+ * @param vlan_id Pointer to store the VLAN ID if found (may be NULL)
+ * @return true if packet has VLAN tag, false otherwise
+ */
+bool packet_has_vlan_tag(const packet_buffer_t *packet, vlan_id_t *vlan_id) {
+    if (packet && packet_parsed_has(packet, PACKET_PARSED_L2)) {
+        if (packet->metadata.vlan_count == 0) {
+            return false;
+        }
+        if (vlan_id) {
+            *vlan_id = packet->metadata.vlan_tci[0] & 0x0FFF;
+        }
+        return true;
+    }
+
+    if (!packet_buffer_is_valid(packet) ||
+        packet->size < PACKET_ETH_ADDRS_LEN + PACKET_VLAN_TAG_LEN) {
+        return false;
+    }
+
+    uint16_t tpid = packet_read_be16(packet->data + PACKET_ETH_ADDRS_LEN);
+    if (tpid != ETHERTYPE_VLAN && tpid != ETHERTYPE_QINQ) {
+        return false;
+    }
+
+    if (vlan_id) {
+        *vlan_id = packet_read_be16(packet->data + PACKET_ETH_ADDRS_LEN + 2) & 0x0FFF;
+    }
+    return true;
+}
+
+/**
+ * @brief Extract VLAN ID from packet
+ *
+ * @param packet Pointer to packet buffer
+ * @param vlan_id Output parameter to store VLAN ID
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if the frame is untagged
+ */
+status_t packet_get_vlan_id(const packet_buffer_t *packet, vlan_id_t *vlan_id) {
+    if (!packet || !vlan_id) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    return packet_has_vlan_tag(packet, vlan_id) ? STATUS_SUCCESS : STATUS_NOT_FOUND;
+}
+
+/**
+ * @brief Copy a packet from source to destination
+ *
+ * The destination keeps its own buffer and default headroom; it is grown
+ * if it cannot hold the source data.
+ *
+ * @param packet Source packet
+ * @param out_packet Destination packet
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t packet_copy(const packet_buffer_t *packet, packet_buffer_t *out_packet) {
+    if (!packet_buffer_is_valid(packet) || !packet_buffer_is_valid(out_packet)) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Invalid parameters for packet_copy");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    status_t cow = packet_make_writable(out_packet);
+    if (cow != STATUS_SUCCESS || packet == out_packet) {
+        return cow;
+    }
+
+    // The copy is always linear
+    if (out_packet->next) {
+        packet_buffer_free(out_packet->next);
+        out_packet->next = NULL;
+    }
+
+    uint32_t length = packet->next ? packet_chain_length(packet) : packet->size;
+    if (out_packet->capacity < length) {
+        status_t status = packet_buffer_resize(out_packet, length);
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+    }
+
+    packet_copy_data(packet, 0, out_packet->data, length);
+    out_packet->size = length;
+    out_packet->metadata = packet->metadata;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Set VLAN tag in a packet (modify existing tag if present)
+ *
+ * @param packet Source packet
+ * @param vlan_id VLAN ID to set
+ * @param out_packet Output packet with modified VLAN tag (may equal packet)
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t packet_set_vlan_tag(const packet_buffer_t *packet, vlan_id_t vlan_id, packet_buffer_t *out_packet) {
+    status_t status = packet_copy(packet, out_packet);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    if (!packet_has_vlan_tag(out_packet, NULL)) {
+        return packet_vlan_push(out_packet, ETHERTYPE_VLAN, vlan_id & 0x0FFF);
+    }
+
+    // Keep PCP/DEI bits, replace the VID
+    return packet_vlan_set_vid(out_packet, vlan_id);
+}
+
+/**
+ * @brief Add VLAN tag to a packet that doesn't have one
+ *
+ * @param packet Source packet
+ * @param vlan_id VLAN ID to add
+ * @param out_packet Output packet with added VLAN tag (may equal packet)
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t packet_add_vlan_tag(const packet_buffer_t *packet, vlan_id_t vlan_id, packet_buffer_t *out_packet) {
+    status_t status = packet_copy(packet, out_packet);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    uint16_t tci = (uint16_t)(((packet->metadata.priority & 0x7) << 13) | (vlan_id & 0x0FFF));
+    return packet_vlan_push(out_packet, ETHERTYPE_VLAN, tci);
+}
+
+/**
+ * @brief Remove VLAN tag from a packet
+ *
+ * @param packet Source packet with VLAN tag
+ * @param out_packet Output packet without VLAN tag (may equal packet)
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t packet_remove_vlan_tag(const packet_buffer_t *packet, packet_buffer_t *out_packet) {
+    status_t status = packet_copy(packet, out_packet);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    return packet_vlan_pop(out_packet, NULL);
+}
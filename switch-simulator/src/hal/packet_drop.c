@@ -0,0 +1,205 @@
+/**
+ * @file packet_drop.c
+ * @brief Drop counters by reason and sampled drop capture
+ *
+ * The counters are one per-thread sharded counter set with a word per
+ * reason. Sampling is a per-thread countdown, so only the sampled drops
+ * take the capture ring's lock.
+ */
+
+#include "../../include/hal/packet_drop.h"
+
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "../../include/common/logging.h"
+#include "../../include/common/stats_shard.h"
+
+static stats_shard_set_t *g_drop_counters = NULL;
+static uint32_t g_sample_rate = CONFIG_PACKET_DROP_SAMPLE_RATE;
+
+/* Drops this thread has seen since it last captured one */
+static THREAD_LOCAL uint32_t t_since_sample;
+
+static pthread_mutex_t g_capture_lock = PTHREAD_MUTEX_INITIALIZER;
+static packet_drop_record_t g_capture[CONFIG_PACKET_DROP_CAPTURE_SIZE];
+static uint32_t g_capture_head;     /* Next slot written */
+static uint32_t g_capture_count;
+
+static const char *const g_reason_names[PACKET_DROP_REASON_COUNT] = {
+    [PACKET_DROP_NONE]          = "none",
+    [PACKET_DROP_PIPELINE]      = "pipeline",
+    [PACKET_DROP_INVALID]       = "invalid",
+    [PACKET_DROP_RECIRC_LIMIT]  = "recirc-limit",
+    [PACKET_DROP_PORT_DOWN]     = "port-down",
+    [PACKET_DROP_RX_RING_FULL]  = "rx-ring-full",
+    [PACKET_DROP_DISPATCH_FULL] = "dispatch-full",
+    [PACKET_DROP_TX_RING_FULL]  = "tx-ring-full",
+    [PACKET_DROP_QOS_QUEUE]     = "qos-queue",
+    [PACKET_DROP_MTU_EXCEEDED]  = "mtu-exceeded",
+    [PACKET_DROP_TX_OFFLOAD]    = "tx-offload",
+    [PACKET_DROP_TX_ERROR]      = "tx-error",
+    [PACKET_DROP_VLAN_FILTER]   = "vlan-filter",
+    [PACKET_DROP_STP_BLOCKED]   = "stp-blocked",
+    [PACKET_DROP_STORM_CONTROL] = "storm-control",
+    [PACKET_DROP_ACL_DENY]      = "acl-deny",
+    [PACKET_DROP_IP_HEADER]     = "ip-header",
+    [PACKET_DROP_TTL_EXCEEDED]  = "ttl-exceeded",
+    [PACKET_DROP_NO_ROUTE]      = "no-route",
+    [PACKET_DROP_FRAG_NEEDED]   = "frag-needed",
+    [PACKET_DROP_FRAGMENT]      = "fragment",
+    [PACKET_DROP_NEIGHBOR]      = "neighbor",
+    [PACKET_DROP_PUNT]          = "punt",
+    [PACKET_DROP_INTERNAL]      = "internal",
+    [PACKET_DROP_MPLS_LABEL]    = "mpls-label",
+    [PACKET_DROP_POLICER]       = "policer",
+    [PACKET_DROP_CONNTRACK]     = "conntrack",
+};
+
+status_t packet_drop_init(void) {
+    stats_shard_set_t *set;
+    status_t status;
+
+    status = stats_shard_create(PACKET_DROP_REASON_COUNT, &set);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to create drop counters");
+        return status;
+    }
+
+    packet_drop_clear_capture();
+    __atomic_store_n(&g_drop_counters, set, __ATOMIC_RELEASE);
+    return STATUS_SUCCESS;
+}
+
+void packet_drop_cleanup(void) {
+    stats_shard_set_t *set = __atomic_exchange_n(&g_drop_counters, NULL, __ATOMIC_ACQ_REL);
+
+    stats_shard_destroy(set);
+}
+
+/**
+ * @brief Copy a dropped packet into the capture ring
+ */
+static void packet_drop_capture(const packet_buffer_t *packet, packet_drop_reason_t reason) {
+    packet_drop_record_t record;
+    struct timespec ts;
+
+    memset(&record, 0, sizeof(record));
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    record.time_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    record.reason = (uint8_t)reason;
+    record.direction = (uint8_t)packet->metadata.direction;
+    record.port = packet->metadata.port;
+    record.vlan = packet->metadata.vlan;
+    record.length = packet_chain_length(packet);
+    record.captured = record.length < PACKET_DROP_CAPTURE_BYTES ? record.length : PACKET_DROP_CAPTURE_BYTES;
+    if (packet_peek_data(packet, 0, record.data, record.captured) != STATUS_SUCCESS) {
+        record.captured = 0;
+    }
+
+    pthread_mutex_lock(&g_capture_lock);
+    g_capture[g_capture_head] = record;
+    g_capture_head = (g_capture_head + 1) % CONFIG_PACKET_DROP_CAPTURE_SIZE;
+    if (g_capture_count < CONFIG_PACKET_DROP_CAPTURE_SIZE) {
+        g_capture_count++;
+    }
+    pthread_mutex_unlock(&g_capture_lock);
+}
+
+void packet_drop_count(packet_buffer_t *packet, packet_drop_reason_t reason) {
+    stats_shard_set_t *set = __atomic_load_n(&g_drop_counters, __ATOMIC_RELAXED);
+    uint32_t rate;
+
+    if ((uint32_t)reason >= PACKET_DROP_REASON_COUNT || reason == PACKET_DROP_NONE) {
+        reason = PACKET_DROP_INTERNAL;
+    }
+    if (packet) {
+        if (packet->metadata.drop_reason != PACKET_DROP_NONE) {
+            return;
+        }
+        packet->metadata.drop_reason = (uint8_t)reason;
+    }
+    if (!set) {
+        return;
+    }
+    stats_shard_add(&stats_shard_local(set)[reason], 1);
+
+    rate = __atomic_load_n(&g_sample_rate, __ATOMIC_RELAXED);
+    if (!packet || rate == 0 || ++t_since_sample < rate) {
+        return;
+    }
+    t_since_sample = 0;
+    packet_drop_capture(packet, reason);
+}
+
+void packet_drop_count_burst(packet_buffer_t **pkts, uint32_t first, uint32_t count,
+                             packet_drop_reason_t reason) {
+    for (uint32_t i = first; i < count; i++) {
+        packet_drop_count(pkts[i], reason);
+    }
+}
+
+const char *packet_drop_reason_name(packet_drop_reason_t reason) {
+    if ((uint32_t)reason >= PACKET_DROP_REASON_COUNT) {
+        return "unknown";
+    }
+    return g_reason_names[reason];
+}
+
+status_t packet_drop_get_counters(uint64_t counts[PACKET_DROP_REASON_COUNT]) {
+    stats_shard_set_t *set = __atomic_load_n(&g_drop_counters, __ATOMIC_ACQUIRE);
+
+    if (!counts) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (!set) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    stats_shard_fold(set, 0, PACKET_DROP_REASON_COUNT, counts);
+    return STATUS_SUCCESS;
+}
+
+void packet_drop_clear_counters(void) {
+    stats_shard_set_t *set = __atomic_load_n(&g_drop_counters, __ATOMIC_ACQUIRE);
+
+    if (set) {
+        stats_shard_clear(set, 0, PACKET_DROP_REASON_COUNT);
+    }
+}
+
+void packet_drop_set_sample_rate(uint32_t rate) {
+    __atomic_store_n(&g_sample_rate, rate, __ATOMIC_RELAXED);
+}
+
+uint32_t packet_drop_get_sample_rate(void) {
+    return __atomic_load_n(&g_sample_rate, __ATOMIC_RELAXED);
+}
+
+uint32_t packet_drop_read_capture(packet_drop_record_t *records, uint32_t max) {
+    uint32_t n;
+    uint32_t oldest;
+
+    if (!records || max == 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&g_capture_lock);
+    n = g_capture_count < max ? g_capture_count : max;
+    // Skip the records that do not fit, keeping the newest
+    oldest = (g_capture_head + CONFIG_PACKET_DROP_CAPTURE_SIZE - n) % CONFIG_PACKET_DROP_CAPTURE_SIZE;
+    for (uint32_t i = 0; i < n; i++) {
+        records[i] = g_capture[(oldest + i) % CONFIG_PACKET_DROP_CAPTURE_SIZE];
+    }
+    pthread_mutex_unlock(&g_capture_lock);
+
+    return n;
+}
+
+void packet_drop_clear_capture(void) {
+    pthread_mutex_lock(&g_capture_lock);
+    g_capture_head = 0;
+    g_capture_count = 0;
+    pthread_mutex_unlock(&g_capture_lock);
+}
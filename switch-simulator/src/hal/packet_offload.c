@@ -0,0 +1,415 @@
+/**
+ * @file packet_offload.c
+ * @brief Implementation of checksum and TCP segmentation offload
+ *
+ * Checksums are summed over the whole packet chain, so payloads sliced
+ * from other packets need no linearizing; a segment that starts at an odd
+ * byte of the summed range has its partial sum byte-swapped, which is all
+ * the ones' complement sum needs. TSO segments are one fresh header
+ * segment each, followed by a zero-copy slice of the original payload,
+ * the same shape IP fragments are built in.
+ */
+#include <string.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/config.h"
+#include "common/logging.h"
+#include "hal/packet.h"
+#include "hal/driver.h"
+#include "hal/packet_offload.h"
+
+#define OFFLOAD_PROTO_TCP       6
+#define OFFLOAD_PROTO_UDP       17
+#define OFFLOAD_IPV4_CSUM_OFF   10      /* header_checksum in the IPv4 header */
+#define OFFLOAD_TCP_CSUM_OFF    16
+#define OFFLOAD_UDP_CSUM_OFF    6
+#define OFFLOAD_TCP_FIN         0x01
+#define OFFLOAD_TCP_PSH         0x08
+#define OFFLOAD_TCP_CWR         0x80
+
+/**
+ * @brief Headers of an IP frame, as offsets into its first segment
+ */
+typedef struct {
+    uint32_t l3;                /**< IP header */
+    uint32_t l4;                /**< Transport header */
+    uint32_t l4_len;            /**< Transport header and payload */
+    uint8_t proto;              /**< Transport protocol */
+    bool ipv6;
+} offload_frame_t;
+
+static inline uint16_t offload_read16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline void offload_write16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static inline uint32_t offload_read32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void offload_write32(uint8_t *p, uint32_t v) {
+    offload_write16(p, (uint16_t)(v >> 16));
+    offload_write16(p + 2, (uint16_t)v);
+}
+
+uint32_t packet_csum_add(uint32_t sum, const void *data, uint32_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t acc = sum;
+
+    while (len >= 2) {
+        acc += offload_read16(p);
+        p += 2;
+        len -= 2;
+    }
+    if (len) {
+        acc += (uint32_t)p[0] << 8;
+    }
+
+    while (acc >> 32) {
+        acc = (acc & 0xFFFFFFFFu) + (acc >> 32);
+    }
+    return (uint32_t)acc;
+}
+
+uint16_t packet_csum_fold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+/**
+ * @brief Sum a byte range of a packet chain
+ */
+static uint32_t offload_sum_chain(const packet_buffer_t *packet, uint32_t offset, uint32_t len,
+                                  uint32_t sum) {
+    uint32_t done = 0;
+
+    for (const packet_buffer_t *seg = packet; seg && done < len; seg = seg->next) {
+        if (offset >= seg->size) {
+            offset -= seg->size;
+            continue;
+        }
+
+        uint32_t n = seg->size - offset;
+        if (n > len - done) {
+            n = len - done;
+        }
+
+        uint16_t part = (uint16_t)~packet_csum_fold(packet_csum_add(0, seg->data + offset, n));
+        if (done & 1) {
+            part = (uint16_t)((part << 8) | (part >> 8));
+        }
+        sum += part;
+        sum += sum < part;          // End-around carry
+        done += n;
+        offset = 0;
+    }
+
+    return sum;
+}
+
+/**
+ * @brief Find the IP and transport headers of a frame
+ *
+ * @return true if the IP header and its length fields are usable
+ */
+static bool offload_frame_get(packet_buffer_t *packet, offload_frame_t *frame) {
+    if (packet_ensure_parsed(packet) != STATUS_SUCCESS ||
+        !packet_parsed_has(packet, PACKET_PARSED_L3)) {
+        return false;
+    }
+
+    const uint8_t *data = packet->data;
+    uint32_t chain = packet_chain_length(packet);
+
+    frame->l3 = packet_l3_offset(packet);
+    frame->l4 = packet_l4_offset(packet);
+    frame->proto = packet->metadata.l4_proto;
+    frame->ipv6 = packet_has_proto(packet, PACKET_PROTO_IPV6);
+
+    uint32_t l3_end;
+    if (frame->ipv6) {
+        l3_end = frame->l3 + 40 + offload_read16(data + frame->l3 + 4);
+    } else {
+        l3_end = frame->l3 + offload_read16(data + frame->l3 + 2);
+    }
+    if (l3_end > chain) {
+        return false;
+    }
+
+    frame->l4_len = 0;
+    if (packet_parsed_has(packet, PACKET_PARSED_L4) && frame->l4 <= l3_end) {
+        frame->l4_len = l3_end - frame->l4;
+    }
+    return true;
+}
+
+/**
+ * @brief Sum of the TCP/UDP pseudo-header
+ */
+static uint32_t offload_pseudo_sum(const packet_buffer_t *packet, const offload_frame_t *frame,
+                                   uint32_t l4_len) {
+    const uint8_t *ip = packet->data + frame->l3;
+    uint32_t sum;
+
+    if (frame->ipv6) {
+        sum = packet_csum_add(0, ip + 8, 32);
+        sum += l4_len >> 16;
+    } else {
+        sum = packet_csum_add(0, ip + 12, 8);
+    }
+    return sum + (l4_len & 0xFFFF) + frame->proto;
+}
+
+/**
+ * @brief Offset of the checksum field in a transport header, 0 if none is offloaded
+ */
+static uint32_t offload_l4_csum_off(const offload_frame_t *frame) {
+    if (frame->proto == OFFLOAD_PROTO_TCP) {
+        return OFFLOAD_TCP_CSUM_OFF;
+    }
+    if (frame->proto == OFFLOAD_PROTO_UDP) {
+        return OFFLOAD_UDP_CSUM_OFF;
+    }
+    return 0;
+}
+
+/**
+ * @brief Fill in the IPv4 header checksum
+ */
+static void offload_fill_ip(packet_buffer_t *packet, const offload_frame_t *frame) {
+    uint8_t *ip = packet->data + frame->l3;
+    uint32_t ihl = (ip[0] & 0x0F) * 4;
+
+    offload_write16(ip + OFFLOAD_IPV4_CSUM_OFF, 0);
+    offload_write16(ip + OFFLOAD_IPV4_CSUM_OFF, packet_csum_fold(packet_csum_add(0, ip, ihl)));
+}
+
+/**
+ * @brief Fill in the TCP/UDP checksum
+ *
+ * @return false if the transport header is not in the first segment
+ */
+static bool offload_fill_l4(packet_buffer_t *packet, const offload_frame_t *frame) {
+    uint32_t field = offload_l4_csum_off(frame);
+
+    if (!field || frame->l4_len < field + 2 || frame->l4 + field + 2 > packet->size) {
+        return false;
+    }
+
+    uint8_t *csum = packet->data + frame->l4 + field;
+    offload_write16(csum, 0);
+
+    uint32_t sum = offload_sum_chain(packet, frame->l4, frame->l4_len,
+                                     offload_pseudo_sum(packet, frame, frame->l4_len));
+    uint16_t value = packet_csum_fold(sum);
+    if (value == 0 && frame->proto == OFFLOAD_PROTO_UDP) {
+        value = 0xFFFF;             // Zero means no checksum for UDP
+    }
+    offload_write16(csum, value);
+    return true;
+}
+
+/**
+ * @brief Fill in the checksums flagged in flags
+ */
+static status_t offload_fill(packet_buffer_t *packet, uint16_t flags) {
+    offload_frame_t frame;
+
+    if (packet_make_writable(packet) != STATUS_SUCCESS || !offload_frame_get(packet, &frame)) {
+        return STATUS_INVALID_PACKET;
+    }
+
+    if ((flags & PACKET_OFFLOAD_IP_CSUM) && !frame.ipv6) {
+        offload_fill_ip(packet, &frame);
+    }
+    if ((flags & PACKET_OFFLOAD_L4_CSUM) && !offload_fill_l4(packet, &frame)) {
+        return STATUS_INVALID_PACKET;
+    }
+
+    packet->metadata.offload &= (uint16_t)~(flags & (PACKET_OFFLOAD_IP_CSUM | PACKET_OFFLOAD_L4_CSUM));
+    return STATUS_SUCCESS;
+}
+
+status_t packet_offload_resolve(packet_buffer_t *packet, uint32_t driver_flags) {
+    if (!packet) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    uint16_t pending = packet->metadata.offload & PACKET_OFFLOAD_TX_MASK;
+    if (!pending) {
+        return STATUS_SUCCESS;
+    }
+
+    if (pending & PACKET_OFFLOAD_TSO) {
+        // A segmenting driver fills in the checksums of every segment
+        return (driver_flags & DRIVER_FLAG_TSO) ? STATUS_SUCCESS : STATUS_NOT_SUPPORTED;
+    }
+    if (driver_flags & DRIVER_FLAG_TX_CSUM) {
+        return STATUS_SUCCESS;
+    }
+
+    return offload_fill(packet, pending);
+}
+
+/**
+ * @brief Build one TSO segment
+ *
+ * @param packet TSO frame
+ * @param frame Its headers
+ * @param hdr_len Bytes from the frame start to the end of the TCP header
+ * @param offset Offset of the segment payload in the TCP payload
+ * @param len Segment payload length
+ * @param index Segment number
+ * @param last Whether this is the last segment
+ * @return New segment, or NULL
+ */
+static packet_buffer_t *offload_tso_segment(const packet_buffer_t *packet, const offload_frame_t *frame,
+                                            uint32_t hdr_len, uint32_t offset, uint32_t len,
+                                            uint32_t index, bool last) {
+    packet_buffer_t *seg = hdr_len <= CONFIG_PACKET_SEGMENT_SIZE ? packet_segment_alloc() :
+                                                                   packet_buffer_alloc(hdr_len);
+    packet_buffer_t *payload = packet_buffer_slice(packet, hdr_len + offset, len);
+
+    if (!seg || !payload || packet_append_data(seg, packet->data, hdr_len) != STATUS_SUCCESS) {
+        if (seg) {
+            packet_destroy(seg);
+        }
+        if (payload) {
+            packet_destroy(payload);
+        }
+        return NULL;
+    }
+    seg->metadata = packet->metadata;
+    seg->metadata.offload &= (uint16_t)~PACKET_OFFLOAD_TX_MASK;
+    seg->metadata.tso_mss = 0;
+    packet_invalidate_parse(seg);
+    packet_chain_append(seg, payload);
+
+    uint8_t *ip = seg->data + frame->l3;
+    uint8_t *tcp = seg->data + frame->l4;
+    uint32_t tcp_hlen = hdr_len - frame->l4;
+
+    if (frame->ipv6) {
+        offload_write16(ip + 4, (uint16_t)(frame->l4 - frame->l3 - 40 + tcp_hlen + len));
+    } else {
+        offload_write16(ip + 2, (uint16_t)(frame->l4 - frame->l3 + tcp_hlen + len));
+        offload_write16(ip + 4, (uint16_t)(offload_read16(ip + 4) + index));
+        offload_fill_ip(seg, frame);
+    }
+
+    offload_write32(tcp + 4, offload_read32(tcp + 4) + offset);
+    if (!last) {
+        tcp[13] &= (uint8_t)~(OFFLOAD_TCP_FIN | OFFLOAD_TCP_PSH);
+    }
+    if (index) {
+        tcp[13] &= (uint8_t)~OFFLOAD_TCP_CWR;
+    }
+
+    offload_frame_t seg_frame = *frame;
+    seg_frame.l4_len = tcp_hlen + len;
+    offload_fill_l4(seg, &seg_frame);
+    return seg;
+}
+
+status_t packet_offload_tx(packet_buffer_t *packet, packet_buffer_t **segs, uint32_t max,
+                           uint32_t *count) {
+    offload_frame_t frame;
+
+    if (!packet || !count) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    *count = 0;
+
+    uint16_t pending = packet->metadata.offload & PACKET_OFFLOAD_TX_MASK;
+    if (!(pending & PACKET_OFFLOAD_TSO)) {
+        return pending ? offload_fill(packet, pending) : STATUS_SUCCESS;
+    }
+
+    if (!offload_frame_get(packet, &frame) || frame.proto != OFFLOAD_PROTO_TCP ||
+        packet_has_proto(packet, PACKET_PROTO_IP_FRAG) || frame.l4_len < 20 ||
+        frame.l4 + 20 > packet->size) {
+        return STATUS_INVALID_PACKET;
+    }
+
+    uint32_t tcp_hlen = (packet->data[frame.l4 + 12] >> 4) * 4;
+    uint32_t hdr_len = frame.l4 + tcp_hlen;
+    if (tcp_hlen < 20 || tcp_hlen > frame.l4_len || hdr_len > packet->size) {
+        return STATUS_INVALID_PACKET;
+    }
+
+    uint32_t payload = frame.l4_len - tcp_hlen;
+    uint32_t mss = packet->metadata.tso_mss;
+    if (mss == 0 || payload <= mss) {
+        // Fits one segment: only the checksums are left to do
+        packet->metadata.offload &= (uint16_t)~PACKET_OFFLOAD_TSO;
+        return offload_fill(packet, PACKET_OFFLOAD_IP_CSUM | PACKET_OFFLOAD_L4_CSUM);
+    }
+
+    uint32_t nsegs = (payload + mss - 1) / mss;
+    if (!segs || nsegs > max) {
+        return STATUS_RESOURCE_EXCEEDED;
+    }
+
+    for (uint32_t i = 0; i < nsegs; i++) {
+        uint32_t offset = i * mss;
+        uint32_t len = payload - offset < mss ? payload - offset : mss;
+
+        segs[i] = offload_tso_segment(packet, &frame, hdr_len, offset, len, i, i + 1 == nsegs);
+        if (!segs[i]) {
+            while (i--) {
+                packet_destroy(segs[i]);
+            }
+            LOG_DEBUG(LOG_CATEGORY_HAL, "No buffers to segment a TSO frame of %u bytes", payload);
+            return STATUS_NO_MEMORY;
+        }
+    }
+
+    *count = nsegs;
+    return STATUS_SUCCESS;
+}
+
+void packet_offload_rx(packet_buffer_t *packet) {
+    offload_frame_t frame;
+
+    if (!packet) {
+        return;
+    }
+
+    packet->metadata.offload &= (uint16_t)~(PACKET_OFFLOAD_RX_MASK | PACKET_OFFLOAD_TX_MASK);
+    if (!offload_frame_get(packet, &frame)) {
+        return;
+    }
+
+    if (!frame.ipv6) {
+        const uint8_t *ip = packet->data + frame.l3;
+        if (packet_csum_fold(packet_csum_add(0, ip, (ip[0] & 0x0F) * 4)) != 0) {
+            packet->metadata.offload |= PACKET_OFFLOAD_RX_BAD;
+            return;
+        }
+        packet->metadata.offload |= PACKET_OFFLOAD_RX_IP_GOOD;
+    }
+
+    uint32_t field = offload_l4_csum_off(&frame);
+    if (!field || packet_has_proto(packet, PACKET_PROTO_IP_FRAG) || frame.l4_len < field + 2 ||
+        frame.l4 + field + 2 > packet->size) {
+        return;
+    }
+
+    // An IPv4 UDP datagram may go without a checksum
+    if (frame.proto == OFFLOAD_PROTO_UDP && !frame.ipv6 &&
+        offload_read16(packet->data + frame.l4 + field) == 0) {
+        packet->metadata.offload |= PACKET_OFFLOAD_RX_L4_GOOD;
+        return;
+    }
+
+    uint32_t sum = offload_sum_chain(packet, frame.l4, frame.l4_len,
+                                     offload_pseudo_sum(packet, &frame, frame.l4_len));
+    packet->metadata.offload |= packet_csum_fold(sum) == 0 ? PACKET_OFFLOAD_RX_L4_GOOD :
+                                                            PACKET_OFFLOAD_RX_BAD;
+}
@@ -0,0 +1,241 @@
+/**
+ * @file packet_profile.c
+ * @brief Pipeline latency histograms for packet processors
+ *
+ * The histograms are one per-thread sharded counter set, PACKET_PROFILE_WORDS
+ * counters per histogram. Stage names and the clock calibration point are
+ * only touched outside the data path.
+ */
+
+#include "../../include/hal/packet_profile.h"
+
+#if CONFIG_ENABLE_PIPELINE_PROFILING
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../../include/common/logging.h"
+
+stats_shard_set_t *g_packet_profile = NULL;
+bool g_packet_profile_counters = false;
+
+static pthread_mutex_t g_profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static char g_stage_names[PACKET_PROFILE_STAGES][PACKET_PROFILE_NAME_MAX];
+
+/* Cycle counter and wall clock at packet_init(), to convert cycles to time */
+static uint64_t g_start_cycles;
+static uint64_t g_start_ns;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+status_t packet_profile_init(void) {
+    stats_shard_set_t *set;
+    status_t status;
+
+    status = stats_shard_create((size_t)PACKET_PROFILE_HISTOGRAMS * PACKET_PROFILE_WORDS, &set);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to create pipeline profile histograms");
+        return status;
+    }
+
+    pthread_mutex_lock(&g_profile_lock);
+    memset(g_stage_names, 0, sizeof(g_stage_names));
+    g_start_ns = monotonic_ns();
+    g_start_cycles = packet_profile_now();
+    pthread_mutex_unlock(&g_profile_lock);
+
+    __atomic_store_n(&g_packet_profile, set, __ATOMIC_RELEASE);
+    LOG_INFO(LOG_CATEGORY_HAL, "Pipeline profiling enabled");
+    return STATUS_SUCCESS;
+}
+
+void packet_profile_cleanup(void) {
+    stats_shard_set_t *set = __atomic_exchange_n(&g_packet_profile, NULL, __ATOMIC_ACQ_REL);
+
+    stats_shard_destroy(set);
+}
+
+status_t packet_profile_set_name(uint32_t handle, const char *name) {
+    if (handle >= PACKET_PROFILE_STAGES) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_profile_lock);
+    if (name) {
+        snprintf(g_stage_names[handle], PACKET_PROFILE_NAME_MAX, "%s", name);
+    } else {
+        g_stage_names[handle][0] = '\0';
+    }
+    pthread_mutex_unlock(&g_profile_lock);
+
+    return STATUS_SUCCESS;
+}
+
+status_t packet_profile_get(uint32_t hist, packet_profile_hist_t *out) {
+    stats_shard_set_t *set = __atomic_load_n(&g_packet_profile, __ATOMIC_ACQUIRE);
+
+    if (hist >= PACKET_PROFILE_HISTOGRAMS || !out) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (!set) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    // packet_profile_hist_t has the layout of a histogram's counters
+    stats_shard_fold(set, (size_t)hist * PACKET_PROFILE_WORDS, PACKET_PROFILE_WORDS, (uint64_t *)out);
+    return STATUS_SUCCESS;
+}
+
+uint64_t packet_profile_percentile(const packet_profile_hist_t *hist, double percentile) {
+    uint64_t rank;
+    uint64_t seen = 0;
+
+    if (!hist || hist->count == 0) {
+        return 0;
+    }
+    if (percentile < 0.0) {
+        percentile = 0.0;
+    } else if (percentile > 100.0) {
+        percentile = 100.0;
+    }
+
+    // The sample of this rank, counting from 1
+    rank = (uint64_t)(percentile / 100.0 * (double)hist->count + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (uint32_t b = 0; b < PACKET_PROFILE_BUCKETS; b++) {
+        seen += hist->buckets[b];
+        if (seen >= rank) {
+            return packet_profile_bucket_floor(b);
+        }
+    }
+    return packet_profile_bucket_floor(PACKET_PROFILE_BUCKETS - 1);
+}
+
+double packet_profile_cycles_per_us(void) {
+    uint64_t ns;
+    uint64_t cycles;
+
+    pthread_mutex_lock(&g_profile_lock);
+    ns = monotonic_ns() - g_start_ns;
+    cycles = packet_profile_now() - g_start_cycles;
+    pthread_mutex_unlock(&g_profile_lock);
+
+    return ns ? (double)cycles * 1000.0 / (double)ns : 0.0;
+}
+
+void packet_profile_clear(uint32_t hist) {
+    stats_shard_set_t *set = __atomic_load_n(&g_packet_profile, __ATOMIC_ACQUIRE);
+
+    if (!set) {
+        return;
+    }
+    if (hist >= PACKET_PROFILE_HISTOGRAMS) {
+        stats_shard_clear(set, 0, (size_t)PACKET_PROFILE_HISTOGRAMS * PACKET_PROFILE_WORDS);
+    } else {
+        stats_shard_clear(set, (size_t)hist * PACKET_PROFILE_WORDS, PACKET_PROFILE_WORDS);
+    }
+}
+
+status_t packet_profile_set_counters(bool enable) {
+    // Workers open their groups on first use; one here tells whether there are any
+    if (enable && !perf_counters_thread()) {
+        return STATUS_NOT_SUPPORTED;
+    }
+    __atomic_store_n(&g_packet_profile_counters, enable, __ATOMIC_RELAXED);
+    LOG_INFO(LOG_CATEGORY_HAL, "Pipeline hardware counters %s", enable ? "enabled" : "disabled");
+    return STATUS_SUCCESS;
+}
+
+size_t packet_profile_report(char *buf, size_t len) {
+    packet_profile_hist_t hist;
+    double per_us = packet_profile_cycles_per_us();
+    size_t used = 0;
+    int n;
+
+    if (!buf || len == 0) {
+        return 0;
+    }
+    buf[0] = '\0';
+
+#define PROFILE_APPEND(...)                                                     \
+    do {                                                                        \
+        n = snprintf(buf + (used < len ? used : len - 1),                       \
+                     used < len ? len - used : 1, __VA_ARGS__);                \
+        if (n > 0) {                                                            \
+            used += (size_t)n;                                                  \
+        }                                                                       \
+    } while (0)
+
+    PROFILE_APPEND("Cycles per packet, %.1f cycles/us\n", per_us);
+    PROFILE_APPEND("%-6s %-20s %12s %10s %10s %10s %10s\n",
+                   "stage", "name", "samples", "mean", "p50", "p99", "p99.9");
+
+    for (uint32_t h = 0; h < PACKET_PROFILE_HISTOGRAMS; h++) {
+        char name[PACKET_PROFILE_NAME_MAX];
+        char handle[8];
+
+        if (packet_profile_get(h, &hist) != STATUS_SUCCESS || hist.count == 0) {
+            continue;
+        }
+        if (h == PACKET_PROFILE_RESIDENCY) {
+            snprintf(handle, sizeof(handle), "ring");
+            snprintf(name, sizeof(name), "rx-to-tx");
+        } else {
+            snprintf(handle, sizeof(handle), "%u", h);
+            pthread_mutex_lock(&g_profile_lock);
+            snprintf(name, sizeof(name), "%s", g_stage_names[h][0] ? g_stage_names[h] : "-");
+            pthread_mutex_unlock(&g_profile_lock);
+        }
+        PROFILE_APPEND("%-6s %-20s %12llu %10llu %10llu %10llu %10llu\n", handle, name,
+                       (unsigned long long)hist.count,
+                       (unsigned long long)(hist.total / hist.count),
+                       (unsigned long long)packet_profile_percentile(&hist, 50.0),
+                       (unsigned long long)packet_profile_percentile(&hist, 99.0),
+                       (unsigned long long)packet_profile_percentile(&hist, 99.9));
+    }
+
+    // Hardware events per packet, for the stages they were counted for
+    bool header = false;
+    for (uint32_t h = 0; h < PACKET_PROFILE_STAGES; h++) {
+        char name[PACKET_PROFILE_NAME_MAX];
+        perf_sample_t events;
+        double packets;
+
+        if (packet_profile_get(h, &hist) != STATUS_SUCCESS || hist.count == 0 ||
+            hist.events[PERF_COUNTER_CYCLES] + hist.events[PERF_COUNTER_INSTRUCTIONS] == 0) {
+            continue;
+        }
+        if (!header) {
+            PROFILE_APPEND("\nHardware events per packet\n");
+            PROFILE_APPEND("%-6s %-20s %6s %10s %10s %10s %10s %10s %-8s\n", "stage", "name", "ipc",
+                           "cycles", "insns", "llc-miss", "br-miss", "dtlb-miss", "bound");
+            header = true;
+        }
+        memcpy(events.values, hist.events, sizeof(events.values));
+        packets = (double)hist.count;
+        pthread_mutex_lock(&g_profile_lock);
+        snprintf(name, sizeof(name), "%s", g_stage_names[h][0] ? g_stage_names[h] : "-");
+        pthread_mutex_unlock(&g_profile_lock);
+        PROFILE_APPEND("%-6u %-20s %6.2f %10.1f %10.1f %10.3f %10.3f %10.3f %-8s\n", h, name,
+                       perf_sample_ipc(&events),
+                       (double)events.values[PERF_COUNTER_CYCLES] / packets,
+                       (double)events.values[PERF_COUNTER_INSTRUCTIONS] / packets,
+                       (double)events.values[PERF_COUNTER_CACHE_MISSES] / packets,
+                       (double)events.values[PERF_COUNTER_BRANCH_MISSES] / packets,
+                       (double)events.values[PERF_COUNTER_DTLB_MISSES] / packets,
+                       perf_sample_bound(&events));
+    }
+#undef PROFILE_APPEND
+
+    return used;
+}
+
+#endif /* CONFIG_ENABLE_PIPELINE_PROFILING */
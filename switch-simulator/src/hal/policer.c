@@ -0,0 +1,676 @@
+/**
+ * @file policer.c
+ * @brief Implementation of the srTCM and trTCM policers
+ *
+ * A configured policer is one cache-line aligned entry, published by
+ * pointer and freed through RCU when it is replaced, so its rates and
+ * depths never change under a forwarding thread. The two buckets of an
+ * entry are signed counts of nano-bytes: a rate in bytes per second is
+ * also the nano-bytes a bucket gains per nanosecond, so refilling is one
+ * multiplication with no rounding. A frame takes its tokens with a
+ * fetch-and-subtract and puts them back if that left the bucket below
+ * zero. Only the thread that moves the refill time forward with a
+ * compare-and-swap refills, clamping each bucket to its depth.
+ *
+ * Attachments are policer numbers in flat per-port and per-VLAN tables,
+ * read without a lock. Configuration is serialized by the module lock.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/config.h"
+#include "common/logging.h"
+#include "common/threading.h"
+#include "common/rcu.h"
+#include "common/stats_shard.h"
+#include "hal/packet_drop.h"
+#include "hal/policer.h"
+#include "l2/vlan.h"
+
+#define POLICER_NS_PER_SEC          1000000000ULL
+
+/**
+ * @brief Smallest default burst, a full-sized Ethernet frame
+ */
+#define POLICER_MIN_DEFAULT_BURST   1518ULL
+
+/**
+ * @brief Counters of a policer, by index in its stats_shard block
+ */
+enum {
+    POLICER_CTR_GREEN_PACKETS = 0,
+    POLICER_CTR_GREEN_BYTES,
+    POLICER_CTR_YELLOW_PACKETS,
+    POLICER_CTR_YELLOW_BYTES,
+    POLICER_CTR_RED_PACKETS,
+    POLICER_CTR_RED_BYTES,
+    POLICER_CTR_DROPPED,
+    POLICER_CTR_COUNT
+};
+
+/**
+ * @brief Token bucket, in nano-bytes
+ */
+typedef struct {
+    int64_t tokens;                 /**< Updated atomically; briefly negative while a take is undone */
+    int64_t depth;                  /**< Burst size */
+    uint64_t rate;                  /**< Bytes per second, nano-bytes per nanosecond */
+    uint64_t fill_ns;               /**< Refill time that fills the bucket from empty */
+} policer_bucket_t;
+
+/**
+ * @brief Published policer
+ */
+typedef struct __attribute__((aligned(64))) {
+    uint64_t last_ns;               /**< Time of the last refill, updated by CAS */
+    policer_bucket_t committed;
+    policer_bucket_t excess;        /**< srTCM excess bucket, trTCM peak bucket */
+    policer_config_t config;
+    uint32_t id;
+    rcu_head_t rcu;
+} policer_entry_t;
+
+/**
+ * @brief Policer module state
+ */
+static struct {
+    bool initialized;
+    spinlock_t lock;                /**< Serializes configuration */
+    uint32_t handle;                /**< Ingress stage */
+    uint32_t attached;              /**< Ingress attachments, the stage does nothing without */
+    policer_entry_t **entries;      /**< CONFIG_MAX_POLICERS + 1 published entries (RCU) */
+    stats_shard_set_t *counters;    /**< POLICER_CTR_COUNT counters per policer */
+    uint16_t port_ingress[CONFIG_MAX_PORTS];
+    uint16_t port_egress[CONFIG_MAX_PORTS];
+    uint16_t vlan_ingress[MAX_VLANS];
+} g_policer = {0};
+
+/**
+ * @brief Current monotonic time in nanoseconds
+ */
+static inline uint64_t policer_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * POLICER_NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+static void policer_entry_free(rcu_head_t *head) {
+    free((uint8_t *)head - offsetof(policer_entry_t, rcu));
+}
+
+/**
+ * @brief Set up a full bucket
+ *
+ * @param bucket Bucket
+ * @param rate Bytes per second
+ * @param burst Bytes
+ * @param fill_bytes Bytes one refill may add, at least the burst
+ */
+static void policer_bucket_setup(policer_bucket_t *bucket, uint64_t rate, uint64_t burst,
+                                 uint64_t fill_bytes) {
+    bucket->rate = rate;
+    bucket->depth = (int64_t)(burst * POLICER_NS_PER_SEC);
+    bucket->tokens = bucket->depth;
+    bucket->fill_ns = rate ? (fill_bytes * POLICER_NS_PER_SEC + rate - 1) / rate : 0;
+}
+
+/**
+ * @brief Add tokens to a bucket, up to its depth
+ *
+ * @return Tokens that did not fit
+ */
+static int64_t policer_bucket_fill(policer_bucket_t *bucket, int64_t tokens) {
+    int64_t old = __atomic_load_n(&bucket->tokens, __ATOMIC_RELAXED);
+    int64_t next;
+
+    if (tokens <= 0) {
+        return 0;
+    }
+    do {
+        next = old + tokens;
+        if (next > bucket->depth) {
+            next = old > bucket->depth ? old : bucket->depth;
+        }
+    } while (!__atomic_compare_exchange_n(&bucket->tokens, &old, next, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return old + tokens - next;
+}
+
+/**
+ * @brief Take tokens from a bucket if it holds them
+ */
+static inline bool policer_bucket_take(policer_bucket_t *bucket, int64_t tokens) {
+    if (__atomic_sub_fetch(&bucket->tokens, tokens, __ATOMIC_RELAXED) >= 0) {
+        return true;
+    }
+    __atomic_add_fetch(&bucket->tokens, tokens, __ATOMIC_RELAXED);
+    return false;
+}
+
+/**
+ * @brief Refill both buckets for the time since the last refill
+ *
+ * Threads that lose the race for the refill time leave it to the winner.
+ * The srTCM excess bucket only gets what overflows the committed one.
+ */
+static void policer_refill(policer_entry_t *entry, uint64_t now) {
+    uint64_t last = __atomic_load_n(&entry->last_ns, __ATOMIC_RELAXED);
+    uint64_t elapsed, ns;
+    int64_t overflow;
+
+    if (now <= last ||
+        !__atomic_compare_exchange_n(&entry->last_ns, &last, now, false,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return;
+    }
+    elapsed = now - last;
+
+    ns = elapsed < entry->committed.fill_ns ? elapsed : entry->committed.fill_ns;
+    overflow = policer_bucket_fill(&entry->committed, (int64_t)(entry->committed.rate * ns));
+    if (entry->config.mode == POLICER_MODE_SRTCM) {
+        policer_bucket_fill(&entry->excess, overflow);
+    } else {
+        ns = elapsed < entry->excess.fill_ns ? elapsed : entry->excess.fill_ns;
+        policer_bucket_fill(&entry->excess, (int64_t)(entry->excess.rate * ns));
+    }
+}
+
+/**
+ * @brief Color a frame (RFC 2697 section 3, RFC 2698 section 3)
+ *
+ * @param entry Policer
+ * @param bytes Frame length
+ * @param in Color the frame arrived with, green when color-blind
+ * @return Color of the frame
+ */
+static policer_color_t policer_mark(policer_entry_t *entry, uint32_t bytes, policer_color_t in) {
+    int64_t tokens = (int64_t)((uint64_t)bytes * POLICER_NS_PER_SEC);
+
+    if (in == POLICER_COLOR_RED) {
+        return POLICER_COLOR_RED;
+    }
+    if (entry->config.mode == POLICER_MODE_SRTCM) {
+        if (in == POLICER_COLOR_GREEN && policer_bucket_take(&entry->committed, tokens)) {
+            return POLICER_COLOR_GREEN;
+        }
+        return policer_bucket_take(&entry->excess, tokens) ? POLICER_COLOR_YELLOW : POLICER_COLOR_RED;
+    }
+
+    // trTCM: a frame over the peak rate takes nothing from the committed bucket
+    if (!policer_bucket_take(&entry->excess, tokens)) {
+        return POLICER_COLOR_RED;
+    }
+    if (in == POLICER_COLOR_GREEN && policer_bucket_take(&entry->committed, tokens)) {
+        return POLICER_COLOR_GREEN;
+    }
+    return POLICER_COLOR_YELLOW;
+}
+
+/**
+ * @brief Meter a frame, count it and apply the action of its color
+ *
+ * @param entry Policer
+ * @param packet Frame
+ * @param now Current time (ns)
+ * @param ctr Counters of this thread
+ * @return true if the frame may continue
+ */
+static bool policer_meter(policer_entry_t *entry, packet_buffer_t *packet, uint64_t now, uint64_t *ctr) {
+    uint32_t bytes = packet_chain_length(packet);
+    policer_color_t in = POLICER_COLOR_GREEN;
+    policer_color_t color;
+    policer_action_t action;
+    uint64_t *c;
+
+    if (entry->config.color_aware && packet->metadata.color <= POLICER_COLOR_RED) {
+        in = (policer_color_t)packet->metadata.color;
+    }
+    policer_refill(entry, now);
+    color = policer_mark(entry, bytes, in);
+    packet->metadata.color = (uint8_t)color;
+
+    c = &ctr[(entry->id - 1) * POLICER_CTR_COUNT];
+    switch (color) {
+        case POLICER_COLOR_GREEN:
+            stats_shard_add(&c[POLICER_CTR_GREEN_PACKETS], 1);
+            stats_shard_add(&c[POLICER_CTR_GREEN_BYTES], bytes);
+            return true;
+        case POLICER_COLOR_YELLOW:
+            stats_shard_add(&c[POLICER_CTR_YELLOW_PACKETS], 1);
+            stats_shard_add(&c[POLICER_CTR_YELLOW_BYTES], bytes);
+            action = entry->config.yellow_action;
+            break;
+        default:
+            stats_shard_add(&c[POLICER_CTR_RED_PACKETS], 1);
+            stats_shard_add(&c[POLICER_CTR_RED_BYTES], bytes);
+            action = entry->config.red_action;
+            break;
+    }
+    if (action != POLICER_ACTION_DROP) {
+        return true;
+    }
+    stats_shard_add(&c[POLICER_CTR_DROPPED], 1);
+    packet_drop_count(packet, PACKET_DROP_POLICER);
+    return false;
+}
+
+/**
+ * @brief Published entry of a policer number, NULL if none
+ *
+ * Called in an RCU read section.
+ */
+static inline policer_entry_t *policer_entry(uint32_t policer_id) {
+    if (policer_id == POLICER_NONE || policer_id > CONFIG_MAX_POLICERS) {
+        return NULL;
+    }
+    return __atomic_load_n(&g_policer.entries[policer_id], __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Ingress stage: police each frame against its port, then its VLAN
+ *
+ * The clock is read once per burst.
+ */
+static void policer_ingress_burst(packet_buffer_t **pkts, uint32_t count, packet_result_t *results,
+                                  void *user_data) {
+    uint64_t *ctr;
+    uint64_t now;
+
+    (void)user_data;
+    for (uint32_t i = 0; i < count; i++) {
+        results[i] = PACKET_RESULT_FORWARD;
+    }
+    if (__atomic_load_n(&g_policer.attached, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+    ctr = stats_shard_local(g_policer.counters);
+    if (!ctr || rcu_read_lock() != STATUS_SUCCESS) {
+        return;
+    }
+
+    now = policer_now_ns();
+    for (uint32_t i = 0; i < count; i++) {
+        packet_buffer_t *packet = pkts[i];
+        port_id_t port = packet->metadata.port;
+        vlan_id_t vlan = packet->metadata.vlan;
+        policer_entry_t *entry;
+
+        if (port < CONFIG_MAX_PORTS) {
+            entry = policer_entry(__atomic_load_n(&g_policer.port_ingress[port], __ATOMIC_RELAXED));
+            if (entry && !policer_meter(entry, packet, now, ctr)) {
+                results[i] = PACKET_RESULT_DROP;
+                continue;
+            }
+        }
+        if (vlan < MAX_VLANS) {
+            entry = policer_entry(__atomic_load_n(&g_policer.vlan_ingress[vlan], __ATOMIC_RELAXED));
+            if (entry && !policer_meter(entry, packet, now, ctr)) {
+                results[i] = PACKET_RESULT_DROP;
+            }
+        }
+    }
+    rcu_read_unlock();
+}
+
+/**
+ * @brief Initialize policing with no policer and register the ingress stage
+ *
+ * @return status_t Status code
+ */
+status_t policer_init(void) {
+    status_t status;
+
+    if (g_policer.initialized) {
+        LOG_WARNING(LOG_CATEGORY_HAL, "Policer: Already initialized");
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    g_policer.entries = calloc(CONFIG_MAX_POLICERS + 1, sizeof(*g_policer.entries));
+    if (!g_policer.entries) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Policer: Failed to allocate the policer table");
+        return STATUS_NO_MEMORY;
+    }
+    status = stats_shard_create((size_t)CONFIG_MAX_POLICERS * POLICER_CTR_COUNT, &g_policer.counters);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Policer: Failed to create counters");
+        free(g_policer.entries);
+        g_policer.entries = NULL;
+        return status;
+    }
+
+    spinlock_init(&g_policer.lock);
+    g_policer.attached = 0;
+    memset(g_policer.port_ingress, 0, sizeof(g_policer.port_ingress));
+    memset(g_policer.port_egress, 0, sizeof(g_policer.port_egress));
+    memset(g_policer.vlan_ingress, 0, sizeof(g_policer.vlan_ingress));
+    __atomic_store_n(&g_policer.initialized, true, __ATOMIC_RELEASE);
+
+    status = packet_register_burst_processor(policer_ingress_burst, POLICER_PROCESSOR_PRIORITY, NULL,
+                                             &g_policer.handle);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Policer: Failed to register the ingress stage: %d", status);
+        __atomic_store_n(&g_policer.initialized, false, __ATOMIC_RELEASE);
+        stats_shard_destroy(g_policer.counters);
+        g_policer.counters = NULL;
+        free(g_policer.entries);
+        g_policer.entries = NULL;
+        return status;
+    }
+    packet_set_processor_name(g_policer.handle, "policer");
+
+    LOG_INFO(LOG_CATEGORY_HAL, "Policer: Module initialized, %u policers", (uint32_t)CONFIG_MAX_POLICERS);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Unregister the ingress stage and free every policer
+ *
+ * @return status_t Status code
+ */
+status_t policer_cleanup(void) {
+    if (!g_policer.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    packet_unregister_processor(g_policer.handle);
+    __atomic_store_n(&g_policer.initialized, false, __ATOMIC_RELEASE);
+    rcu_synchronize();
+
+    for (uint32_t id = 1; id <= CONFIG_MAX_POLICERS; id++) {
+        free(g_policer.entries[id]);
+    }
+    free(g_policer.entries);
+    g_policer.entries = NULL;
+    stats_shard_destroy(g_policer.counters);
+    g_policer.counters = NULL;
+
+    LOG_INFO(LOG_CATEGORY_HAL, "Policer: Module cleaned up");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Default burst of a rate: 10 ms of traffic, at least one frame
+ */
+static inline uint64_t policer_default_burst(uint64_t rate) {
+    uint64_t burst = rate / 100;
+    return burst > POLICER_MIN_DEFAULT_BURST ? burst : POLICER_MIN_DEFAULT_BURST;
+}
+
+/**
+ * @brief Check a configuration
+ */
+static bool policer_config_valid(const policer_config_t *config) {
+    if (config->mode != POLICER_MODE_SRTCM && config->mode != POLICER_MODE_TRTCM) {
+        return false;
+    }
+    if (config->yellow_action > POLICER_ACTION_DROP || config->red_action > POLICER_ACTION_DROP) {
+        return false;
+    }
+    if (config->cir == 0 || config->cir > POLICER_MAX_RATE ||
+        config->cbs > POLICER_MAX_BURST || config->ebs > POLICER_MAX_BURST) {
+        return false;
+    }
+    if (config->mode == POLICER_MODE_TRTCM &&
+        (config->pir < config->cir || config->pir > POLICER_MAX_RATE || config->pbs > POLICER_MAX_BURST)) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Create a policer or change its configuration
+ *
+ * @param policer_id Policer
+ * @param config Configuration
+ * @return status_t Status code
+ */
+status_t policer_set(uint32_t policer_id, const policer_config_t *config) {
+    policer_entry_t *entry, *old;
+    uint64_t cbs, pbs;
+
+    if (!g_policer.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (policer_id == POLICER_NONE || policer_id > CONFIG_MAX_POLICERS || !config ||
+        !policer_config_valid(config)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    entry = aligned_alloc(64, sizeof(*entry));
+    if (!entry) {
+        return STATUS_NO_MEMORY;
+    }
+    memset(entry, 0, sizeof(*entry));
+    entry->config = *config;
+    entry->id = policer_id;
+    cbs = config->cbs ? config->cbs : policer_default_burst(config->cir);
+    if (config->mode == POLICER_MODE_SRTCM) {
+        // One refill may have to fill the excess bucket through the committed one
+        policer_bucket_setup(&entry->committed, config->cir, cbs, cbs + config->ebs);
+        policer_bucket_setup(&entry->excess, 0, config->ebs, config->ebs);
+    } else {
+        pbs = config->pbs ? config->pbs : policer_default_burst(config->pir);
+        policer_bucket_setup(&entry->committed, config->cir, cbs, cbs);
+        policer_bucket_setup(&entry->excess, config->pir, pbs, pbs);
+    }
+    entry->config.cbs = cbs;
+    entry->config.pbs = config->mode == POLICER_MODE_TRTCM ? pbs : 0;
+    entry->last_ns = policer_now_ns();
+
+    spinlock_acquire(&g_policer.lock);
+    old = __atomic_exchange_n(&g_policer.entries[policer_id], entry, __ATOMIC_ACQ_REL);
+    spinlock_release(&g_policer.lock);
+    if (old) {
+        rcu_retire(&old->rcu, policer_entry_free);
+    }
+
+    LOG_DEBUG(LOG_CATEGORY_HAL, "Policer: %u %s, CIR %llu B/s", policer_id,
+              config->mode == POLICER_MODE_SRTCM ? "srTCM" : "trTCM", (unsigned long long)config->cir);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Delete a policer
+ *
+ * @param policer_id Policer
+ * @return status_t Status code
+ */
+status_t policer_delete(uint32_t policer_id) {
+    policer_entry_t *old;
+
+    if (!g_policer.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (policer_id == POLICER_NONE || policer_id > CONFIG_MAX_POLICERS) {
+        return STATUS_NOT_FOUND;
+    }
+
+    spinlock_acquire(&g_policer.lock);
+    old = __atomic_exchange_n(&g_policer.entries[policer_id], NULL, __ATOMIC_ACQ_REL);
+    spinlock_release(&g_policer.lock);
+    if (!old) {
+        return STATUS_NOT_FOUND;
+    }
+    rcu_retire(&old->rcu, policer_entry_free);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Point an attachment at a policer, keeping the ingress count
+ *
+ * Called with the module lock held.
+ */
+static void policer_attach(uint16_t *slot, uint32_t policer_id, bool ingress) {
+    uint16_t old = *slot;
+
+    __atomic_store_n(slot, (uint16_t)policer_id, __ATOMIC_RELAXED);
+    if (ingress) {
+        g_policer.attached += (policer_id != POLICER_NONE) - (old != POLICER_NONE);
+    }
+}
+
+/**
+ * @brief Attach a policer to a port
+ *
+ * @param port_id Port
+ * @param direction Direction
+ * @param policer_id Policer
+ * @return status_t Status code
+ */
+status_t policer_attach_port(port_id_t port_id, packet_direction_t direction, uint32_t policer_id) {
+    if (!g_policer.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (port_id >= CONFIG_MAX_PORTS || policer_id > CONFIG_MAX_POLICERS ||
+        (direction != PACKET_DIR_RX && direction != PACKET_DIR_TX)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_policer.lock);
+    if (direction == PACKET_DIR_RX) {
+        policer_attach(&g_policer.port_ingress[port_id], policer_id, true);
+    } else {
+        policer_attach(&g_policer.port_egress[port_id], policer_id, false);
+    }
+    spinlock_release(&g_policer.lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Attach a policer to the ingress of a VLAN
+ *
+ * @param vlan_id VLAN
+ * @param policer_id Policer
+ * @return status_t Status code
+ */
+status_t policer_attach_vlan(vlan_id_t vlan_id, uint32_t policer_id) {
+    if (!g_policer.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (vlan_id >= MAX_VLANS || policer_id > CONFIG_MAX_POLICERS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_policer.lock);
+    policer_attach(&g_policer.vlan_ingress[vlan_id], policer_id, true);
+    spinlock_release(&g_policer.lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Meter a frame and apply the action of its color
+ *
+ * @param policer_id Policer
+ * @param packet Frame
+ * @return true if the frame may continue
+ */
+bool policer_police(uint32_t policer_id, packet_buffer_t *packet) {
+    policer_entry_t *entry;
+    uint64_t *ctr;
+    bool pass = true;
+
+    if (!__atomic_load_n(&g_policer.initialized, __ATOMIC_ACQUIRE) || !packet) {
+        return true;
+    }
+    ctr = stats_shard_local(g_policer.counters);
+    if (!ctr || rcu_read_lock() != STATUS_SUCCESS) {
+        return true;
+    }
+    entry = policer_entry(policer_id);
+    if (entry) {
+        pass = policer_meter(entry, packet, policer_now_ns(), ctr);
+    }
+    rcu_read_unlock();
+    return pass;
+}
+
+/**
+ * @brief Police a burst against the egress policer of a port
+ *
+ * @param port_id Egress port
+ * @param pkts Frames
+ * @param count Number of frames
+ * @return Number of frames that pass
+ */
+uint32_t policer_egress_burst(port_id_t port_id, packet_buffer_t **pkts, uint32_t count) {
+    policer_entry_t *entry;
+    uint32_t pass = 0;
+    uint64_t *ctr;
+    uint64_t now;
+
+    if (!__atomic_load_n(&g_policer.initialized, __ATOMIC_ACQUIRE) || port_id >= CONFIG_MAX_PORTS ||
+        __atomic_load_n(&g_policer.port_egress[port_id], __ATOMIC_RELAXED) == POLICER_NONE) {
+        return count;
+    }
+    ctr = stats_shard_local(g_policer.counters);
+    if (!ctr || rcu_read_lock() != STATUS_SUCCESS) {
+        return count;
+    }
+
+    entry = policer_entry(__atomic_load_n(&g_policer.port_egress[port_id], __ATOMIC_RELAXED));
+    if (!entry) {
+        rcu_read_unlock();
+        return count;
+    }
+    now = policer_now_ns();
+    for (uint32_t i = 0; i < count; i++) {
+        packet_buffer_t *packet = pkts[i];
+
+        // Passing frames keep their order; dropped ones are swapped behind them
+        if (policer_meter(entry, packet, now, ctr)) {
+            pkts[i] = pkts[pass];
+            pkts[pass++] = packet;
+        }
+    }
+    rcu_read_unlock();
+    return pass;
+}
+
+/**
+ * @brief Get the counters of a policer
+ *
+ * @param policer_id Policer
+ * @param stats Counters
+ * @return status_t Status code
+ */
+status_t policer_get_stats(uint32_t policer_id, policer_stats_t *stats) {
+    uint64_t ctr[POLICER_CTR_COUNT];
+
+    if (!g_policer.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (policer_id == POLICER_NONE || policer_id > CONFIG_MAX_POLICERS || !stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    stats_shard_fold(g_policer.counters, (size_t)(policer_id - 1) * POLICER_CTR_COUNT, POLICER_CTR_COUNT, ctr);
+    stats->green_packets = ctr[POLICER_CTR_GREEN_PACKETS];
+    stats->green_bytes = ctr[POLICER_CTR_GREEN_BYTES];
+    stats->yellow_packets = ctr[POLICER_CTR_YELLOW_PACKETS];
+    stats->yellow_bytes = ctr[POLICER_CTR_YELLOW_BYTES];
+    stats->red_packets = ctr[POLICER_CTR_RED_PACKETS];
+    stats->red_bytes = ctr[POLICER_CTR_RED_BYTES];
+    stats->dropped_packets = ctr[POLICER_CTR_DROPPED];
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Clear the counters of a policer
+ *
+ * @param policer_id Policer
+ * @return status_t Status code
+ */
+status_t policer_clear_stats(uint32_t policer_id) {
+    if (!g_policer.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (policer_id == POLICER_NONE || policer_id > CONFIG_MAX_POLICERS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    stats_shard_clear(g_policer.counters, (size_t)(policer_id - 1) * POLICER_CTR_COUNT, POLICER_CTR_COUNT);
+    return STATUS_SUCCESS;
+}
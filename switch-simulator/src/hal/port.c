@@ -12,6 +12,9 @@
 #include "../../include/hal/port.h"
 #include "../../include/common/logging.h"
 #include "../../include/common/utils.h"
+#include "../../include/hal/packet_offload.h"
+#include "../../include/l2/lag.h"
+#include "../../include/l2/mirror.h"
 
 /* Forward declarations for hardware simulation functions */
 extern status_t hw_sim_init(void);
@@ -21,6 +24,9 @@ extern status_t hw_sim_set_port_config(port_id_t port_id, const port_config_t *c
 extern status_t hw_sim_get_port_config(port_id_t port_id, port_config_t *config);
 extern status_t hw_sim_get_port_count(uint32_t *count);
 extern status_t hw_sim_clear_port_stats(port_id_t port_id);
+extern uint32_t hw_sim_get_port_offloads(port_id_t port_id);
+extern status_t hw_sim_get_port_state(port_id_t port_id, port_state_t *state);
+extern status_t hw_sim_get_port_stats(port_id_t port_id, port_stats_t *stats);
 
 // Добавить forward declaration после существующих (строка ~34)
 static status_t port_generate_default_mac(uint16_t port_id, mac_addr_t *mac_addr);
@@ -32,12 +38,43 @@ static bool g_port_initialized = false;
 static uint32_t g_phys_count = 0;
 static port_id_t g_cpu_port_id = 0;
 
-// Глобальная таблица MAC-адресов портов (инициализируется при старте)
-static mac_addr_t g_port_mac_table[MAX_PORTS];
-static bool g_port_mac_initialized[MAX_PORTS] = {false};
+/*
+ * Transmit fast path: what sending needs of a port, one cache line per
+ * port. The hardware simulation publishes state, MTU, driver and offloads
+ * whenever they change (port_fast_path_update()), port_set_mac() the MAC.
+ * Readers take each field with one atomic load, no lock and no copy of
+ * the port configuration.
+ */
+#define PORT_FAST_MAC_SET (1ULL << 63)  /* The MAC word holds an address */
+
+typedef struct __attribute__((aligned(64))) {
+    driver_handle_t driver;
+    uint64_t mac;               /* PORT_FAST_MAC_SET | the six octets, first one highest */
+    uint32_t state;             /* port_state_t, stored last with release */
+    uint32_t mtu;
+    uint32_t offloads;          /* DRIVER_FLAGS_OFFLOAD of the egress */
+} port_fast_t;
+
+static port_fast_t g_port_fast[MAX_PORTS];
+
+static inline uint64_t port_mac_pack(const mac_addr_t *mac)
+{
+    uint64_t word = 0;
+
+    for (int i = 0; i < MAC_ADDR_LEN; i++) {
+        word = (word << 8) | mac->addr[i];
+    }
+    return word | PORT_FAST_MAC_SET;
+}
+
+static inline void port_mac_unpack(uint64_t word, mac_addr_t *mac)
+{
+    for (int i = MAC_ADDR_LEN - 1; i >= 0; i--) {
+        mac->addr[i] = (uint8_t)word;
+        word >>= 8;
+    }
+}
 
-/* Static function prototypes */
-static status_t port_stats_update_tx(port_id_t port_id, size_t length);
 
 
 /**
@@ -76,6 +113,14 @@ status_t port_init(void)
     LOG_INFO(LOG_CATEGORY_HAL, "Detected %u physical ports; CPU-port = %u",
              g_phys_count, g_cpu_port_id);
 
+    /* Ports the hardware simulation set up before us: publish them once */
+    for (uint32_t i = 0; i < g_phys_count && i < MAX_PORTS; i++) {
+        port_info_t info;
+        if (hw_sim_get_port_info((port_id_t)i, &info) == STATUS_SUCCESS) {
+            port_fast_path_update((port_id_t)i, &info, hw_sim_get_port_offloads((port_id_t)i));
+        }
+    }
+
     
     g_port_initialized = true;
 
@@ -312,10 +357,32 @@ status_t port_set_admin_state(port_id_t port_id, bool admin_up)
         LOG_INFO(LOG_CATEGORY_HAL, "Set admin state for port %u to %s",
                 port_id, admin_up ? "up" : "down");
     }
-    
+
     return status;
 }
 
+/**
+ * @brief Enable a port (administrative state up)
+ *
+ * @param port_id Port identifier
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t port_enable(port_id_t port_id)
+{
+    return port_set_admin_state(port_id, true);
+}
+
+/**
+ * @brief Disable a port (administrative state down)
+ *
+ * @param port_id Port identifier
+ * @return status_t STATUS_SUCCESS if successful
+ */
+status_t port_disable(port_id_t port_id)
+{
+    return port_set_admin_state(port_id, false);
+}
+
 /**
  * @brief Get port statistics
  * 
@@ -333,17 +400,13 @@ status_t port_get_stats(port_id_t port_id, port_stats_t *stats)
         return STATUS_INVALID_PARAMETER;
     }
     
-    /* Get port information which includes stats */
-    port_info_t info;
-    status_t status = hw_sim_get_port_info(port_id, &info);
+    /* Only the statistics, folded from the per-thread counters */
+    status_t status = hw_sim_get_port_stats(port_id, stats);
     if (status != STATUS_SUCCESS) {
         LOG_ERROR(LOG_CATEGORY_HAL, "Failed to get statistics for port %u", port_id);
         return status;
     }
     
-    /* Copy statistics */
-    memcpy(stats, &info.stats, sizeof(port_stats_t));
-    
     LOG_DEBUG(LOG_CATEGORY_HAL, "Retrieved statistics for port %u (rx: %lu, tx: %lu)",
              port_id, stats->rx_packets, stats->tx_packets);
     
@@ -436,21 +499,57 @@ bool port_is_valid(port_id_t port_id)
         return false;
     }
     
-    /* Check if port ID is negative */
-    if (port_id < 0) {
-        return false;
+    /* The port count of the hardware simulation is fixed once it is up */
+    return (uint32_t)port_id < g_phys_count;
+}
+
+/**
+ * @brief Check if a port is operationally up, without locks
+ *
+ * @param port_id Port identifier
+ * @return true if port is up, false otherwise
+ */
+bool port_is_up(port_id_t port_id)
+{
+    return port_is_valid(port_id) && port_id < MAX_PORTS &&
+           __atomic_load_n(&g_port_fast[port_id].state, __ATOMIC_ACQUIRE) == PORT_STATE_UP;
+}
+
+/**
+ * @brief Get the MTU of a port, without locks
+ *
+ * @param port_id Port identifier
+ * @return MTU in bytes, 0 for an invalid port
+ */
+uint32_t port_get_mtu(port_id_t port_id)
+{
+    if (!port_is_valid(port_id) || port_id >= MAX_PORTS) {
+        return 0;
     }
-    
-    /* Get total port count */
-    uint32_t total_ports;
-    status_t status = hw_sim_get_port_count(&total_ports);
-    if (status != STATUS_SUCCESS) {
-        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to get port count for validation");
-        return false;
+    return __atomic_load_n(&g_port_fast[port_id].mtu, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Publish the transmit view of a port to the fast path
+ *
+ * State goes last, with release, so a sender that sees the port up also
+ * sees its driver and offloads.
+ *
+ * @param port_id Port identifier
+ * @param info Port information, read under the port lock
+ * @param offloads DRIVER_FLAGS_OFFLOAD of the port
+ */
+void port_fast_path_update(port_id_t port_id, const port_info_t *info, uint32_t offloads)
+{
+    if (port_id >= MAX_PORTS || !info) {
+        return;
     }
-    
-    /* Check if port ID is within range */
-    return (port_id < (port_id_t)total_ports);
+
+    port_fast_t *fast = &g_port_fast[port_id];
+    __atomic_store_n(&fast->driver, info->config.driver, __ATOMIC_RELAXED);
+    __atomic_store_n(&fast->mtu, (uint32_t)info->config.mtu, __ATOMIC_RELAXED);
+    __atomic_store_n(&fast->offloads, offloads, __ATOMIC_RELAXED);
+    __atomic_store_n(&fast->state, (uint32_t)info->state, __ATOMIC_RELEASE);
 }
 
 /**
@@ -474,17 +573,13 @@ status_t port_get_state(port_id_t port_id, port_state_t *state)
         return STATUS_INVALID_PORT;
     }
 
-    /* Get port information which includes state */
-    port_info_t info;
-    status_t status = hw_sim_get_port_info(port_id, &info);
+    /* Read on every transmit: no lock and no counter fold */
+    status_t status = hw_sim_get_port_state(port_id, state);
     if (status != STATUS_SUCCESS) {
         LOG_ERROR(LOG_CATEGORY_HAL, "Failed to get state for port %u", port_id);
         return status;
     }
 
-    /* Return operational state */
-    *state = info.state;
-
     LOG_DEBUG(LOG_CATEGORY_HAL, "Retrieved operational state for port %u: %d",
              port_id, *state);
 
@@ -535,6 +630,40 @@ status_t port_get_list(port_id_t *port_ids, uint32_t *count)
 }
 
 
+/**
+ * @brief Checks that a port can transmit and gets its driver
+ *
+ * A few loads from the fast path descriptor of the port.
+ *
+ * @param port_id        Identifier of the egress port
+ * @param driver         Driver handle of the port
+ * @param offloads       Offloads of the port
+ *
+ * @return STATUS_SUCCESS if the port is up
+ * @return STATUS_INVALID_PORT if port_id is invalid
+ * @return STATUS_PORT_DOWN if the specified port is not in active state
+ */
+static inline status_t port_tx_prepare(port_id_t port_id, driver_handle_t *driver, uint32_t *offloads)
+{
+    /* Validate port index */
+    if (!port_is_valid(port_id) || port_id >= MAX_PORTS) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Invalid port ID %d in port_send_packet", port_id);
+        return STATUS_INVALID_PORT;
+    }
+
+    const port_fast_t *fast = &g_port_fast[port_id];
+    uint32_t state = __atomic_load_n(&fast->state, __ATOMIC_ACQUIRE);
+    if (state != PORT_STATE_UP) {
+        LOG_WARNING_RATELIMITED(LOG_CATEGORY_HAL, "Attempted to send packet on port %d which is not UP (state: %u)",
+                                port_id, state);
+        return STATUS_PORT_DOWN;
+    }
+
+    *driver = __atomic_load_n(&fast->driver, __ATOMIC_RELAXED);
+    *offloads = __atomic_load_n(&fast->offloads, __ATOMIC_RELAXED);
+    return STATUS_SUCCESS;
+}
+
 /**
  * @brief Sends a packet out through the specified port
  *
@@ -543,12 +672,15 @@ status_t port_get_list(port_id_t *port_ids, uint32_t *count)
  * transmission including any hardware-specific operations, and utilizes the
  * underlying driver interface for actual packet transmission.
  *
+ * A LAG port sends out of the member its hash selects (lag.h).
+ *
  * @param port_id        Identifier of the port through which to send the packet
  * @param packet         Pointer to the packet structure to be transmitted
  *
  * @return STATUS_SUCCESS if packet was successfully queued for transmission
  * @return STATUS_INVALID_PARAM if port_id is invalid or packet is NULL
- * @return STATUS_PORT_DOWN if the specified port is not in active state
+ * @return STATUS_PORT_DOWN if the specified port is not in active state or
+ *         is a LAG without a distributing member
  * // @return STATUS_RESOURCE_ERROR if transmission resources couldn't be allocated
  * // @return STATUS_HAL_ERROR for general hardware abstraction layer failures
  */
@@ -560,55 +692,35 @@ status_t port_send_packet(port_id_t port_id, packet_t *packet)
         return STATUS_INVALID_PARAMETER;
     }
 
-    /* Validate port index */
-    if (!port_is_valid(port_id)) {
-        LOG_ERROR(LOG_CATEGORY_HAL, "Invalid port ID %d in port_send_packet", port_id);
-        //return STATUS_INVALID_PARAMETER;
-        return STATUS_INVALID_PORT;
+    if (lag_port_is_lag(port_id)) {
+        port_id = lag_egress_port(port_id, packet);
+        if (port_id == PORT_ID_INVALID) {
+            return STATUS_PORT_DOWN;
+        }
     }
 
-    /* Check if port is operational */
-    port_state_t port_state;
-    status_t status = port_get_state(port_id, &port_state);
+    driver_handle_t driver;
+    uint32_t offloads;
+    status_t status = port_tx_prepare(port_id, &driver, &offloads);
     if (status != STATUS_SUCCESS) {
-        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to get port %d state, error: %d", port_id, status);
-        // return status;
-        // return MAKE_ERROR_CODE(COMPONENT_HAL, ERROR_HAL_OPERATION_FAILED);
-        return ERROR_HAL_OPERATION_FAILED;
+        return status;
     }
 
-    if (port_state != PORT_STATE_UP) {
-        LOG_WARNING (LOG_CATEGORY_HAL, "Attempted to send packet on port %d which is not UP (state: %d)",
-                   port_id, port_state);
-        return STATUS_PORT_DOWN;
+    /* Do in software what the stack left to an egress without the offload */
+    status = packet_offload_resolve(packet, offloads);
+    if (status != STATUS_SUCCESS) {
+        LOG_WARNING_RATELIMITED(LOG_CATEGORY_HAL, "Port %d cannot take offloaded packet, error: %d",
+                                port_id, status);
+        return status;
     }
 
-    /* Access port configuration */
-    // port_config_t *port_config = port_get_config(port_id);
-    // if (port_config == NULL) {
-    //     LOG_ERROR(LOG_CATEGORY_HAL, "Failed to get port %d configuration", port_id);
-    //     return STATUS_HAL_ERROR;
-    // }
-    port_config_t port_config;
-    status = port_get_config(port_id, &port_config);
-    if (status != STATUS_SUCCESS) { 
-        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to get port %d configuration: %s", 
-                 port_id, status_to_string(status));
-        // Поскольку это HAL-ошибка, используем соответствующий код:
-        return ERROR_HAL_OPERATION_FAILED;
-    }   
-
-    /* Update port statistics */
-//    port_stats_update_tx(port_id, packet->length);
-    port_stats_update_tx(port_id, packet->size);
+    mirror_egress_burst(port_id, &packet, 1);
 
     /* Log packet transmission at debug level */
 //    LOG_DEBUG("Sending packet of size %u bytes on port %d", packet->length, port_id);
     LOG_DEBUG(LOG_CATEGORY_HAL , "Sending packet of size %u bytes on port %d", packet->size, port_id);
 
     /* Use the appropriate driver function to transmit the packet */
-//    driver_handle_t driver = port_config->driver;
-    driver_handle_t driver = port_config.driver;
     //return driver_transmit_packet(driver, packet);
     status = driver_transmit_packet(driver, packet);
 
@@ -616,6 +728,88 @@ status_t port_send_packet(port_id_t port_id, packet_t *packet)
     return status;
 }
 
+/**
+ * @brief Sends a burst of packets through a physical port
+ *
+ * The port state, driver and offloads are read once for the whole burst;
+ * the driver gets the burst in one transmit_burst call. Statistics are
+ * counted where the frames leave, in the hardware simulation. A burst to
+ * a LAG port is sent packet by packet, each out of its own member.
+ *
+ * @param port_id        Identifier of the port through which to send the packets
+ * @param pkts           Packets to be transmitted
+ * @param count          Number of packets
+ * @param sent           Number of packets the driver took, may be NULL
+ *
+ * @return STATUS_SUCCESS if every packet was handed to the driver
+ * @return STATUS_INVALID_PARAM if port_id is invalid or pkts is NULL
+ * @return STATUS_PORT_DOWN if the specified port is not in active state
+ * @return STATUS_RESOURCE_BUSY if the driver stopped short of the burst
+ * @return STATUS_NOT_SUPPORTED if the burst stopped at a TSO packet the port
+ *         cannot segment
+ */
+status_t port_send_burst(port_id_t port_id, packet_t **pkts, uint16_t count, uint16_t *sent)
+{
+    if (sent) {
+        *sent = 0;
+    }
+
+    if (pkts == NULL) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Null packet array provided to port_send_burst");
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (count == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    if (lag_port_is_lag(port_id)) {
+        uint16_t done = 0;
+        status_t status = STATUS_SUCCESS;
+        while (done < count && (status = port_send_packet(port_id, pkts[done])) == STATUS_SUCCESS) {
+            done++;
+        }
+        if (sent) {
+            *sent = done;
+        }
+        return status;
+    }
+
+    driver_handle_t driver;
+    uint32_t offloads;
+    status_t status = port_tx_prepare(port_id, &driver, &offloads);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    /* The burst stops short at a packet the egress cannot take */
+    uint16_t ready = 0;
+    status_t offload_status = STATUS_SUCCESS;
+    while (ready < count) {
+        offload_status = packet_offload_resolve(pkts[ready], offloads);
+        if (offload_status != STATUS_SUCCESS) {
+            LOG_WARNING_RATELIMITED(LOG_CATEGORY_HAL, "Port %d cannot take offloaded packet, error: %d",
+                                    port_id, offload_status);
+            break;
+        }
+        ready++;
+    }
+
+    if (ready) {
+        mirror_egress_burst(port_id, pkts, ready);
+    }
+
+    uint16_t done = ready ? driver_transmit_burst(driver, pkts, ready) : 0;
+    if (sent) {
+        *sent = done;
+    }
+
+    LOG_DEBUG(LOG_CATEGORY_HAL, "Sent %u of %u packets on port %d", done, count, port_id);
+    if (done == count) {
+        return STATUS_SUCCESS;
+    }
+    return done == ready && offload_status != STATUS_SUCCESS ? offload_status : STATUS_RESOURCE_BUSY;
+}
+
 
 /**
  * @brief Sends a packet with custom Ethernet header fields
@@ -708,85 +902,14 @@ status_t port_send_packet_ext(port_id_t port_id, packet_t *packet,
 
 
 
-/**
- * @brief Обновляет статистику передачи для указанного порта
- * 
- * @param port_id Идентификатор порта
- * @param length Размер переданного пакета в байтах
- * @return status_t Статус операции
- */
-static status_t port_stats_update_tx(port_id_t port_id, size_t length)
-{
-    /* Проверка инициализации порта */
-    if (!g_port_initialized) {
-        return STATUS_NOT_INITIALIZED;
-    }
-
-    /* Проверка валидности порта */
-    if (!port_is_valid(port_id)) {
-        LOG_ERROR(LOG_CATEGORY_HAL, "Invalid port ID %d in port_stats_update_tx", port_id);
-        return STATUS_INVALID_PORT;
-    }
-
-    /* Получаем текущую информацию о порте */
-    port_info_t info;
-    status_t status = hw_sim_get_port_info(port_id, &info);
-    if (status != STATUS_SUCCESS) {
-        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to get port info for port %u in port_stats_update_tx", port_id);
-        return status;
-    }
-
-    /* Обновляем счетчики передачи данных */
-    info.stats.tx_packets++;
-    info.stats.tx_bytes += length;
-
-    /* В зависимости от размера пакета, обновляем соответствующие счетчики */
-    if (length < 64) {
-        info.stats.tx_packets_64--;  /* Компенсируем увеличение tx_packets */
-        info.stats.tx_packets_lt_64++;
-    } else if (length == 64) {
-        info.stats.tx_packets_64++;
-    } else if (length <= 127) {
-        info.stats.tx_packets_65_127++;
-    } else if (length <= 255) {
-        info.stats.tx_packets_128_255++;
-    } else if (length <= 511) {
-        info.stats.tx_packets_256_511++;
-    } else if (length <= 1023) {
-        info.stats.tx_packets_512_1023++;
-    } else if (length <= 1518) {
-        info.stats.tx_packets_1024_1518++;
-    } else {
-        info.stats.tx_packets_1519_max++;
-    }
-
-    /* Теперь нужно сохранить обновленную статистику обратно в порт */
-    /* Поскольку у нас нет прямой функции для записи только статистики,
-       мы можем использовать имеющийся hw_sim_set_port_config для конфигурации */
-    /* Примечание: в реальной системе лучше иметь отдельную функцию для обновления статистики,
-       но для симуляции мы можем использовать достаточно прямой подход */
-    
-    /* Возможно, нам нужно обновить статистику через API симулятора оборудования.
-       В этом случае мы должны проверить, есть ли функция для обновления статистики в HW SIM API.
-       Если такой функции нет, мы предполагаем, что HW SIM автоматически обновляет статистику
-       при вызове driver_transmit_packet(), и нам не нужно ничего делать здесь. */
-
-    LOG_DEBUG(LOG_CATEGORY_HAL, "Updated TX statistics for port %u: packets=%lu, bytes=%lu",
-              port_id, info.stats.tx_packets, info.stats.tx_bytes);
-
-    return STATUS_SUCCESS;
-}
-
-
-
-
 static status_t port_mac_subsystem_init(void)
 {
     LOG_INFO(LOG_CATEGORY_HAL, "Initializing port MAC address subsystem");
 
-    // Очищаем таблицы
-    memset(g_port_mac_table, 0, sizeof(g_port_mac_table));
-    memset(g_port_mac_initialized, 0, sizeof(g_port_mac_initialized));
+    // Очищаем MAC-адреса, состояние портов в быстром пути остаётся
+    for (uint32_t i = 0; i < MAX_PORTS; i++) {
+        __atomic_store_n(&g_port_fast[i].mac, 0, __ATOMIC_RELAXED);
+    }
 
     // В реальной системе здесь бы читали MAC-адреса из:
     // - EEPROM/Flash
@@ -813,7 +936,8 @@ status_t port_get_mac(uint16_t port_id, mac_addr_t *mac_addr)
     }
 
     // Проверка инициализации порта
-    if (!g_port_mac_initialized[port_id]) {
+    uint64_t word = __atomic_load_n(&g_port_fast[port_id].mac, __ATOMIC_RELAXED);
+    if (!(word & PORT_FAST_MAC_SET)) {
         LOG_WARNING(LOG_CATEGORY_HAL, "port_get_mac: Port %u MAC not initialized, using default", port_id);
         
         // Генерируем MAC по умолчанию: BASE_MAC + port_offset
@@ -822,17 +946,16 @@ status_t port_get_mac(uint16_t port_id, mac_addr_t *mac_addr)
             return status;
         }
         
-        // Сохраняем сгенерированный MAC
-        memcpy(&g_port_mac_table[port_id], mac_addr, sizeof(mac_addr_t));
-        g_port_mac_initialized[port_id] = true;
+        // Сохраняем сгенерированный MAC (гонка безопасна: значение то же)
+        __atomic_store_n(&g_port_fast[port_id].mac, port_mac_pack(mac_addr), __ATOMIC_RELAXED);
         
         LOG_INFO(LOG_CATEGORY_HAL, "Port %u MAC initialized: %02x:%02x:%02x:%02x:%02x:%02x",
                  port_id,
                  mac_addr->addr[0], mac_addr->addr[1], mac_addr->addr[2],
                  mac_addr->addr[3], mac_addr->addr[4], mac_addr->addr[5]);
     } else {
-        // Копируем сохраненный MAC-адрес
-        memcpy(mac_addr, &g_port_mac_table[port_id], sizeof(mac_addr_t));
+        // Сохраненный MAC-адрес - одно слово
+        port_mac_unpack(word, mac_addr);
     }
 
     LOG_DEBUG(LOG_CATEGORY_HAL, "port_get_mac: Port %u MAC: %02x:%02x:%02x:%02x:%02x:%02x",
@@ -875,9 +998,8 @@ status_t port_set_mac(uint16_t port_id, const mac_addr_t *mac_addr)
         return STATUS_INVALID_PARAMETER;
     }
 
-    // Сохраняем MAC-адрес
-    memcpy(&g_port_mac_table[port_id], mac_addr, sizeof(mac_addr_t));
-    g_port_mac_initialized[port_id] = true;
+    // Сохраняем MAC-адрес одной записью: читатели видят старый или новый
+    __atomic_store_n(&g_port_fast[port_id].mac, port_mac_pack(mac_addr), __ATOMIC_RELAXED);
 
     LOG_INFO(LOG_CATEGORY_HAL, "Port %u MAC set to: %02x:%02x:%02x:%02x:%02x:%02x",
              port_id,
@@ -0,0 +1,660 @@
+/**
+ * @file qos.c
+ * @brief Implementation of per-port egress queues and scheduling
+ *
+ * Every queue is a fixed ring of QOS_QUEUE_CAPACITY slots; the configured
+ * limit only decides when tail drop starts. A port keeps one bit per
+ * non-empty queue, so the scheduler finds the highest strict queue with
+ * one bit scan and skips empty DWRR queues without touching them.
+ *
+ * DWRR keeps its position between calls: a burst that ends in the middle
+ * of a queue's turn resumes that turn with the deficit it had left, so
+ * the shares hold however the transmit side sizes its bursts. The WRED
+ * average is sampled on every enqueue and dequeue, which lets it decay
+ * while a queue drains instead of staying high until the next arrival.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/config.h"
+#include "common/logging.h"
+#include "common/threading.h"
+#include "hal/port_types.h"
+#include "hal/qos.h"
+#include "hal/int_telemetry.h"
+
+#if (QOS_QUEUE_CAPACITY & (QOS_QUEUE_CAPACITY - 1)) != 0
+#error "QOS_QUEUE_CAPACITY must be a power of two"
+#endif
+
+/* Fraction bits of the WRED average */
+#define QOS_WRED_FRAC_BITS 16
+
+/**
+ * @brief A queued packet with its length, so the scheduler needs no chain walk
+ */
+typedef struct {
+    packet_buffer_t *pkt;
+    uint32_t len;
+} qos_slot_t;
+
+/**
+ * @brief One egress queue
+ */
+typedef struct {
+    qos_slot_t *slots;              /**< QOS_QUEUE_CAPACITY slots */
+    uint32_t head;                  /**< Index of the oldest packet */
+    uint32_t count;                 /**< Packets queued */
+    uint32_t limit;                 /**< Tail-drop depth */
+    uint32_t quantum;               /**< Bytes added to the deficit per DWRR turn */
+    uint32_t deficit;               /**< Bytes the queue may still send this turn */
+    qos_wred_t wred;
+    uint64_t avg_fp;                /**< WRED average depth, QOS_WRED_FRAC_BITS fraction bits */
+    qos_queue_stats_t stats;        /**< depth and avg_depth are filled on read */
+} qos_queue_t;
+
+/**
+ * @brief QoS state of one port
+ */
+typedef struct __attribute__((aligned(64))) {
+    spinlock_t lock;                /**< Serializes enqueue, dequeue and configuration */
+    bool enabled;
+    qos_trust_t trust;
+    uint8_t pcp_to_queue[8];
+    uint8_t dscp_to_queue[64];
+    uint8_t strict_mask;            /**< Bit per strict queue */
+    uint8_t backlog;                /**< Bit per non-empty queue */
+    uint8_t dwrr_next;              /**< Queue whose DWRR turn it is */
+    bool dwrr_fresh;                /**< The turn has not been credited its quantum yet */
+    uint32_t rng;                   /**< WRED drop decisions */
+    qos_queue_t queues[QOS_QUEUES_PER_PORT];
+} qos_port_t;
+
+/**
+ * @brief QoS module state
+ */
+static struct {
+    bool initialized;
+    spinlock_t lock;                /**< Serializes port allocation */
+    qos_port_t *ports[MAX_PORTS];   /**< Allocated on first enable, kept until shutdown */
+} g_qos = {0};
+
+/**
+ * @brief Next pseudo-random number of a port (xorshift32)
+ */
+static inline uint32_t qos_random(qos_port_t *port) {
+    uint32_t x = port->rng;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    port->rng = x;
+    return x;
+}
+
+/**
+ * @brief Pick the queue of a packet
+ *
+ * @param port Port state
+ * @param packet Packet
+ * @return Queue number
+ */
+static uint8_t qos_classify(const qos_port_t *port, packet_buffer_t *packet) {
+    if (port->trust == QOS_TRUST_DSCP &&
+        packet_ensure_parsed(packet) == STATUS_SUCCESS &&
+        packet_parsed_has(packet, PACKET_PARSED_L3)) {
+        const uint8_t *l3 = packet_l3_header(packet);
+
+        if (packet_has_proto(packet, PACKET_PROTO_IPV4)) {
+            return port->dscp_to_queue[l3[1] >> 2];
+        }
+        if (packet_has_proto(packet, PACKET_PROTO_IPV6)) {
+            uint8_t traffic_class = (uint8_t)(((l3[0] & 0x0F) << 4) | (l3[1] >> 4));
+            return port->dscp_to_queue[traffic_class >> 2];
+        }
+    }
+
+    return port->pcp_to_queue[packet->metadata.priority & 0x7];
+}
+
+/**
+ * @brief Sample the queue depth into the WRED average
+ */
+static inline void qos_wred_sample(qos_queue_t *q) {
+    int64_t depth_fp = (int64_t)q->count << QOS_WRED_FRAC_BITS;
+    int64_t avg_fp = (int64_t)q->avg_fp;
+
+    q->avg_fp = (uint64_t)(avg_fp + ((depth_fp - avg_fp) >> QOS_WRED_EWMA_SHIFT));
+}
+
+/**
+ * @brief Decide whether WRED refuses an arriving packet
+ *
+ * @param port Port state
+ * @param q Queue the packet is headed for (average already sampled)
+ * @return true to drop
+ */
+static bool qos_wred_drop(qos_port_t *port, const qos_queue_t *q) {
+    uint64_t min_fp = (uint64_t)q->wred.min_threshold << QOS_WRED_FRAC_BITS;
+    uint64_t max_fp = (uint64_t)q->wred.max_threshold << QOS_WRED_FRAC_BITS;
+
+    if (q->avg_fp < min_fp) {
+        return false;
+    }
+    if (q->avg_fp >= max_fp) {
+        return true;
+    }
+
+    // Probability as a 16-bit fraction: max_p * (avg - min) / (max - min)
+    uint64_t p16 = ((uint64_t)q->wred.max_drop_percent << 16) / 100;
+    p16 = p16 * (q->avg_fp - min_fp) / (max_fp - min_fp);
+
+    return (qos_random(port) & 0xFFFF) < p16;
+}
+
+/**
+ * @brief Remove the oldest packet of a queue
+ *
+ * @param port Port state (locked)
+ * @param qid Queue number
+ * @return The packet's slot
+ */
+static inline qos_slot_t qos_queue_pop(qos_port_t *port, uint8_t qid) {
+    qos_queue_t *q = &port->queues[qid];
+    qos_slot_t slot = q->slots[q->head];
+
+    q->head = (q->head + 1) & (QOS_QUEUE_CAPACITY - 1);
+    q->count--;
+    if (q->count == 0) {
+        port->backlog &= (uint8_t)~(1u << qid);
+    }
+    if (q->wred.enabled) {
+        qos_wred_sample(q);
+    }
+
+    q->stats.dequeued++;
+    q->stats.dequeued_bytes += slot.len;
+    return slot;
+}
+
+/**
+ * @brief Free every packet queued on a port
+ *
+ * @param port Port state (locked)
+ */
+static void qos_port_flush(qos_port_t *port) {
+    for (uint8_t qid = 0; qid < QOS_QUEUES_PER_PORT; qid++) {
+        qos_queue_t *q = &port->queues[qid];
+
+        while (q->count > 0) {
+            packet_buffer_free(q->slots[q->head].pkt);
+            q->head = (q->head + 1) & (QOS_QUEUE_CAPACITY - 1);
+            q->count--;
+        }
+        q->deficit = 0;
+        q->avg_fp = 0;
+    }
+    port->backlog = 0;
+}
+
+/**
+ * @brief Free a port and its queues
+ *
+ * @param port Port state (may be NULL)
+ */
+static void qos_port_free(qos_port_t *port) {
+    if (!port) {
+        return;
+    }
+
+    qos_port_flush(port);
+    for (uint8_t qid = 0; qid < QOS_QUEUES_PER_PORT; qid++) {
+        free(port->queues[qid].slots);
+    }
+    free(port);
+}
+
+/**
+ * @brief Allocate the state of a port with QoS disabled
+ *
+ * @param port_id Port identifier
+ * @return New port state, or NULL on allocation failure
+ */
+static qos_port_t *qos_port_alloc(port_id_t port_id) {
+    qos_port_t *port = (qos_port_t *)aligned_alloc(64, sizeof(qos_port_t));
+
+    if (!port) {
+        return NULL;
+    }
+    memset(port, 0, sizeof(qos_port_t));
+    spinlock_init(&port->lock);
+    port->rng = 0x9E3779B9u ^ ((uint32_t)port_id << 8);
+
+    for (uint8_t qid = 0; qid < QOS_QUEUES_PER_PORT; qid++) {
+        port->queues[qid].slots = (qos_slot_t *)calloc(QOS_QUEUE_CAPACITY, sizeof(qos_slot_t));
+        if (!port->queues[qid].slots) {
+            qos_port_free(port);
+            return NULL;
+        }
+    }
+
+    return port;
+}
+
+/**
+ * @brief Check a port configuration
+ *
+ * @param config Configuration
+ * @return true if every field is in range
+ */
+static bool qos_config_valid(const qos_port_config_t *config) {
+    if (config->trust != QOS_TRUST_PCP && config->trust != QOS_TRUST_DSCP) {
+        return false;
+    }
+    for (uint32_t i = 0; i < 8; i++) {
+        if (config->pcp_to_queue[i] >= QOS_QUEUES_PER_PORT) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < 64; i++) {
+        if (config->dscp_to_queue[i] >= QOS_QUEUES_PER_PORT) {
+            return false;
+        }
+    }
+
+    for (uint32_t qid = 0; qid < QOS_QUEUES_PER_PORT; qid++) {
+        const qos_queue_config_t *q = &config->queues[qid];
+
+        if (q->sched != QOS_SCHED_STRICT && q->sched != QOS_SCHED_DWRR) {
+            return false;
+        }
+        if (q->sched == QOS_SCHED_DWRR && (q->weight == 0 || q->weight > 255)) {
+            return false;
+        }
+        if (q->limit == 0 || q->limit > QOS_QUEUE_CAPACITY) {
+            return false;
+        }
+        if (q->wred.enabled &&
+            (q->wred.min_threshold >= q->wred.max_threshold ||
+             q->wred.max_threshold > q->limit ||
+             q->wred.max_drop_percent == 0 || q->wred.max_drop_percent > 100)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Initialize QoS with every port sending straight to its TX ring
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t qos_init(void) {
+    if (g_qos.initialized) {
+        return STATUS_SUCCESS;
+    }
+
+    memset(g_qos.ports, 0, sizeof(g_qos.ports));
+    spinlock_init(&g_qos.lock);
+    g_qos.initialized = true;
+
+    LOG_INFO(LOG_CATEGORY_HAL, "QoS initialized: %u egress queues per port", QOS_QUEUES_PER_PORT);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Free all queues and the packets still in them
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t qos_shutdown(void) {
+    if (!g_qos.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    for (uint32_t i = 0; i < MAX_PORTS; i++) {
+        qos_port_free(g_qos.ports[i]);
+        g_qos.ports[i] = NULL;
+    }
+    g_qos.initialized = false;
+
+    LOG_INFO(LOG_CATEGORY_HAL, "QoS shut down");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Fill a configuration with the defaults
+ *
+ * @param[out] config Configuration to fill
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER if config is NULL
+ */
+status_t qos_get_default_config(qos_port_config_t *config) {
+    if (!config) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(config, 0, sizeof(qos_port_config_t));
+    config->trust = QOS_TRUST_PCP;
+    for (uint8_t i = 0; i < 8; i++) {
+        config->pcp_to_queue[i] = i;
+    }
+    for (uint8_t i = 0; i < 64; i++) {
+        config->dscp_to_queue[i] = i >> 3;
+    }
+    for (uint32_t qid = 0; qid < QOS_QUEUES_PER_PORT; qid++) {
+        config->queues[qid].sched = qid == QOS_QUEUES_PER_PORT - 1 ? QOS_SCHED_STRICT : QOS_SCHED_DWRR;
+        config->queues[qid].weight = qid + 1;
+        config->queues[qid].limit = QOS_QUEUE_LIMIT_DEFAULT;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Enable egress queueing on a port, or change its configuration
+ *
+ * @param port_id Egress port
+ * @param config Port configuration
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t qos_port_enable(port_id_t port_id, const qos_port_config_t *config) {
+    if (!CONFIG_ENABLE_QOS) {
+        return STATUS_NOT_SUPPORTED;
+    }
+    if (!g_qos.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (port_id >= MAX_PORTS || !config || !qos_config_valid(config)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_qos.lock);
+    qos_port_t *port = g_qos.ports[port_id];
+    if (!port) {
+        port = qos_port_alloc(port_id);
+        if (!port) {
+            spinlock_release(&g_qos.lock);
+            LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate egress queues for port %u", port_id);
+            return STATUS_NO_MEMORY;
+        }
+        __atomic_store_n(&g_qos.ports[port_id], port, __ATOMIC_RELEASE);
+    }
+    spinlock_release(&g_qos.lock);
+
+    spinlock_acquire(&port->lock);
+    port->trust = config->trust;
+    memcpy(port->pcp_to_queue, config->pcp_to_queue, sizeof(port->pcp_to_queue));
+    memcpy(port->dscp_to_queue, config->dscp_to_queue, sizeof(port->dscp_to_queue));
+    port->strict_mask = 0;
+    for (uint8_t qid = 0; qid < QOS_QUEUES_PER_PORT; qid++) {
+        qos_queue_t *q = &port->queues[qid];
+        const qos_queue_config_t *qc = &config->queues[qid];
+
+        if (qc->sched == QOS_SCHED_STRICT) {
+            port->strict_mask |= (uint8_t)(1u << qid);
+        }
+        q->limit = qc->limit;
+        q->quantum = qc->weight * QOS_DWRR_QUANTUM_BYTES;
+        q->deficit = 0;
+        q->wred = qc->wred;
+    }
+    port->dwrr_fresh = true;
+    __atomic_store_n(&port->enabled, true, __ATOMIC_RELEASE);
+    spinlock_release(&port->lock);
+
+    LOG_INFO(LOG_CATEGORY_HAL, "QoS enabled on port %u (trust %s, strict queues 0x%02x)",
+             port_id, config->trust == QOS_TRUST_DSCP ? "DSCP" : "PCP", port->strict_mask);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Disable egress queueing on a port and drop what it holds
+ *
+ * @param port_id Egress port
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t qos_port_disable(port_id_t port_id) {
+    if (!g_qos.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (port_id >= MAX_PORTS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    qos_port_t *port = __atomic_load_n(&g_qos.ports[port_id], __ATOMIC_ACQUIRE);
+    if (!port) {
+        return STATUS_SUCCESS;
+    }
+
+    spinlock_acquire(&port->lock);
+    __atomic_store_n(&port->enabled, false, __ATOMIC_RELEASE);
+    qos_port_flush(port);
+    spinlock_release(&port->lock);
+
+    LOG_INFO(LOG_CATEGORY_HAL, "QoS disabled on port %u", port_id);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Check whether a port queues its egress traffic
+ *
+ * @param port_id Egress port
+ * @return true if QoS is enabled on the port
+ */
+bool qos_port_enabled(port_id_t port_id) {
+    if (!g_qos.initialized || port_id >= MAX_PORTS) {
+        return false;
+    }
+
+    qos_port_t *port = __atomic_load_n(&g_qos.ports[port_id], __ATOMIC_ACQUIRE);
+    return port && __atomic_load_n(&port->enabled, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Classify and queue a burst of packets
+ *
+ * @param port_id Egress port
+ * @param pkts Packets to queue, reordered so that queued ones come first
+ * @param count Number of packets
+ * @param[out] queued Number of packets queued
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if QoS is not
+ *         enabled on the port
+ */
+status_t qos_enqueue_burst(port_id_t port_id, packet_buffer_t **pkts, uint32_t count,
+                           uint32_t *queued) {
+    uint8_t qids[PACKET_BURST_MAX];
+    uint32_t lens[PACKET_BURST_MAX];
+    uint32_t kept = 0;
+
+    if (!queued || (!pkts && count > 0)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    *queued = 0;
+    if (!qos_port_enabled(port_id)) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    qos_port_t *port = g_qos.ports[port_id];
+
+    for (uint32_t base = 0; base < count; base += PACKET_BURST_MAX) {
+        uint32_t n = count - base < PACKET_BURST_MAX ? count - base : PACKET_BURST_MAX;
+
+        // Parse and measure outside the lock
+        for (uint32_t i = 0; i < n; i++) {
+            qids[i] = qos_classify(port, pkts[base + i]);
+            lens[i] = packet_chain_length(pkts[base + i]);
+        }
+
+        spinlock_acquire(&port->lock);
+        if (!port->enabled) {
+            spinlock_release(&port->lock);
+            if (kept == 0) {
+                return STATUS_NOT_INITIALIZED;
+            }
+            break;
+        }
+
+        for (uint32_t i = 0; i < n; i++) {
+            qos_queue_t *q = &port->queues[qids[i]];
+
+            if (q->wred.enabled) {
+                qos_wred_sample(q);
+                if (qos_wred_drop(port, q)) {
+                    q->stats.wred_drops++;
+                    continue;
+                }
+            }
+            if (q->count >= q->limit) {
+                q->stats.tail_drops++;
+                continue;
+            }
+
+            packet_buffer_t *pkt = pkts[base + i];
+            q->slots[(q->head + q->count) & (QOS_QUEUE_CAPACITY - 1)] = (qos_slot_t){ pkt, lens[i] };
+            q->count++;
+            port->backlog |= (uint8_t)(1u << qids[i]);
+
+            q->stats.enqueued++;
+            q->stats.enqueued_bytes += lens[i];
+            if (q->count > q->stats.max_depth) {
+                q->stats.max_depth = q->count;
+            }
+
+            // Refused packets drift to the tail of the array
+            pkts[base + i] = pkts[kept];
+            pkts[kept++] = pkt;
+        }
+        spinlock_release(&port->lock);
+    }
+
+    *queued = kept;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Take the next packets to send from a port's queues
+ *
+ * @param port_id Egress port
+ * @param pkts Output array; the caller owns the packets
+ * @param max Maximum number of packets to take
+ * @return Number of packets taken
+ */
+uint32_t qos_dequeue_burst(port_id_t port_id, packet_buffer_t **pkts, uint32_t max) {
+    uint32_t n = 0;
+
+    if (!pkts || !qos_port_enabled(port_id)) {
+        return 0;
+    }
+
+    qos_port_t *port = g_qos.ports[port_id];
+    bool stamp = int_telemetry_enabled();
+
+    spinlock_acquire(&port->lock);
+    while (n < max && port->backlog) {
+        uint8_t strict = port->backlog & port->strict_mask;
+
+        if (strict) {
+            uint8_t qid = (uint8_t)(31 - __builtin_clz(strict));
+            qos_queue_t *q = &port->queues[qid];
+
+            while (n < max && q->count > 0) {
+                pkts[n] = qos_queue_pop(port, qid).pkt;
+                if (stamp) {
+                    int_telemetry_note_queue(pkts[n], qid, q->count);
+                }
+                n++;
+            }
+            continue;
+        }
+
+        uint8_t qid = port->dwrr_next;
+        qos_queue_t *q = &port->queues[qid];
+
+        if (port->backlog & (1u << qid)) {
+            if (port->dwrr_fresh) {
+                q->deficit += q->quantum;
+                port->dwrr_fresh = false;
+            }
+            while (n < max && q->count > 0 && q->slots[q->head].len <= q->deficit) {
+                qos_slot_t slot = qos_queue_pop(port, qid);
+                q->deficit -= slot.len;
+                if (stamp) {
+                    int_telemetry_note_queue(slot.pkt, qid, q->count);
+                }
+                pkts[n++] = slot.pkt;
+            }
+            if (q->count == 0) {
+                q->deficit = 0;
+            } else if (n == max) {
+                // Out of budget mid-turn: resume this turn next call
+                break;
+            }
+        }
+
+        port->dwrr_next = (uint8_t)((qid + 1) % QOS_QUEUES_PER_PORT);
+        port->dwrr_fresh = true;
+    }
+    spinlock_release(&port->lock);
+
+    return n;
+}
+
+/**
+ * @brief Get the counters of one egress queue
+ *
+ * @param port_id Egress port
+ * @param queue_id Queue number
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t qos_get_queue_stats(port_id_t port_id, uint8_t queue_id, qos_queue_stats_t *stats) {
+    if (!g_qos.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (port_id >= MAX_PORTS || queue_id >= QOS_QUEUES_PER_PORT || !stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    qos_port_t *port = __atomic_load_n(&g_qos.ports[port_id], __ATOMIC_ACQUIRE);
+    if (!port) {
+        memset(stats, 0, sizeof(qos_queue_stats_t));
+        return STATUS_SUCCESS;
+    }
+
+    spinlock_acquire(&port->lock);
+    const qos_queue_t *q = &port->queues[queue_id];
+    *stats = q->stats;
+    stats->depth = q->count;
+    stats->avg_depth = (uint32_t)(q->avg_fp >> QOS_WRED_FRAC_BITS);
+    spinlock_release(&port->lock);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Reset the counters of one egress queue
+ *
+ * @param port_id Egress port
+ * @param queue_id Queue number
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t qos_clear_queue_stats(port_id_t port_id, uint8_t queue_id) {
+    if (!g_qos.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (port_id >= MAX_PORTS || queue_id >= QOS_QUEUES_PER_PORT) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    qos_port_t *port = __atomic_load_n(&g_qos.ports[port_id], __ATOMIC_ACQUIRE);
+    if (port) {
+        spinlock_acquire(&port->lock);
+        memset(&port->queues[queue_id].stats, 0, sizeof(qos_queue_stats_t));
+        port->queues[queue_id].stats.max_depth = port->queues[queue_id].count;
+        spinlock_release(&port->lock);
+    }
+
+    return STATUS_SUCCESS;
+}
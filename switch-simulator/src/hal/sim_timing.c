@@ -0,0 +1,599 @@
+/**
+ * @file sim_timing.c
+ * @brief Implementation of the ASIC timing model
+ *
+ * Port clocks are kept in picoseconds, so the serialization time of a
+ * minimum frame at 100G is not rounded away; the calendar works in
+ * nanoseconds. A port's departures never go backwards, since a frame
+ * cannot start before the one ahead of it ends, so appending to the tail
+ * of a bucket keeps every port's packets in order.
+ *
+ * One mutex guards the calendar and the port clocks. The release thread
+ * takes everything due under it, then sends outside it, in bursts of
+ * consecutive packets of the same port.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/prctl.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/config.h"
+#include "common/logging.h"
+#include "hal/sim_timing.h"
+
+#if (CONFIG_SIM_TIMING_BUCKETS & (CONFIG_SIM_TIMING_BUCKETS - 1)) != 0
+#error "CONFIG_SIM_TIMING_BUCKETS must be a power of two"
+#endif
+
+#define SIM_TIMING_NS_PER_SEC   1000000000ULL
+#define SIM_TIMING_PS_PER_NS    1000ULL
+#define SIM_TIMING_JITTER_SHIFT 4       /* Jitter estimate moves 1/16 of the way, as in RFC 3550 */
+#define SIM_TIMING_NONE         0       /* Empty list, entries are index + 1 */
+#define SIM_TIMING_HORIZON_NS   ((uint64_t)CONFIG_SIM_TIMING_BUCKETS * CONFIG_SIM_TIMING_BUCKET_NS)
+
+/**
+ * @brief A scheduled packet
+ */
+typedef struct {
+    packet_buffer_t *pkt;
+    uint64_t depart_ns;             /**< Modeled departure */
+    uint32_t next;                  /**< Next entry of the bucket or free list + 1 */
+    port_id_t port_id;
+} sim_timing_entry_t;
+
+/**
+ * @brief Timing state of one port
+ */
+typedef struct {
+    uint64_t busy_until_ps;         /**< End of the last frame scheduled */
+    uint64_t last_latency_ns;       /**< Latency of the last packet, for the jitter estimate */
+    uint64_t jitter_fp;             /**< Jitter estimate, SIM_TIMING_JITTER_SHIFT fraction bits */
+    sim_timing_port_stats_t stats;  /**< jitter_ns is filled on read */
+} sim_timing_port_t;
+
+/**
+ * @brief Timing model state
+ */
+static struct {
+    bool initialized;
+    bool enabled;
+    bool running;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;            /**< Calendar went from empty to occupied, or stopping */
+    sim_timing_release_fn release;
+    sim_timing_stage_config_t stages[SIM_TIMING_STAGE_COUNT];
+    sim_timing_entry_t *entries;    /**< CONFIG_SIM_TIMING_MAX_PACKETS entries */
+    uint32_t free_head;             /**< First free entry + 1 */
+    uint32_t free_count;
+    uint32_t head[CONFIG_SIM_TIMING_BUCKETS];
+    uint32_t tail[CONFIG_SIM_TIMING_BUCKETS];
+    uint64_t cursor;                /**< First bucket not yet released, in bucket numbers */
+    uint32_t scheduled;             /**< Entries in the calendar */
+    uint64_t rng;                   /**< Stage jitter */
+    sim_timing_port_t ports[MAX_PORTS];
+} g_timing = {0};
+
+/* Private function declarations */
+static void *sim_timing_thread(void *arg);
+
+/**
+ * @brief Current monotonic time in nanoseconds
+ */
+static inline uint64_t sim_timing_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * SIM_TIMING_NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Next value of the jitter generator (xorshift64)
+ */
+static inline uint64_t sim_timing_random(void)
+{
+    uint64_t x = g_timing.rng;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    g_timing.rng = x;
+    return x;
+}
+
+/**
+ * @brief Time a packet spends in the pipeline, in picoseconds
+ *
+ * @param is_ip Whether the packet passes the L3 stage
+ */
+static uint64_t sim_timing_pipeline_ps(bool is_ip)
+{
+    uint64_t ns = 0;
+
+    for (uint32_t i = 0; i < SIM_TIMING_STAGE_COUNT; i++) {
+        const sim_timing_stage_config_t *stage = &g_timing.stages[i];
+
+        if (i == SIM_TIMING_STAGE_L3 && !is_ip) {
+            continue;
+        }
+        ns += stage->latency_ns + (uint64_t)stage->memory_accesses * CONFIG_SIM_MEMORY_DELAY_NS;
+        if (stage->jitter_ns) {
+            ns += sim_timing_random() % ((uint64_t)stage->jitter_ns + 1);
+        }
+    }
+    return ns * SIM_TIMING_PS_PER_NS;
+}
+
+/**
+ * @brief Fill the stages with the defaults
+ */
+static void sim_timing_default_stages(void)
+{
+    static const uint32_t accesses[SIM_TIMING_STAGE_COUNT] = {
+        [SIM_TIMING_STAGE_PARSER] = 0,
+        [SIM_TIMING_STAGE_L2]     = 2,      /* VLAN, then MAC table */
+        [SIM_TIMING_STAGE_L3]     = 2,      /* Trie root, then one node */
+        [SIM_TIMING_STAGE_ACL]    = 1,
+        [SIM_TIMING_STAGE_EGRESS] = 1,      /* Next hop rewrite */
+    };
+    uint32_t latency = CONFIG_SIM_PACKET_DELAY_US * 1000U / SIM_TIMING_STAGE_COUNT;
+
+    for (uint32_t i = 0; i < SIM_TIMING_STAGE_COUNT; i++) {
+        g_timing.stages[i].latency_ns = latency;
+        g_timing.stages[i].memory_accesses = accesses[i];
+        g_timing.stages[i].jitter_ns = 0;
+    }
+}
+
+/* Implementation */
+
+/**
+ * @brief Allocate the calendar and start the release thread, model disabled
+ *
+ * @param release Function that sends released packets
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t sim_timing_init(sim_timing_release_fn release)
+{
+    pthread_condattr_t attr;
+
+    if (g_timing.initialized) {
+        return STATUS_SUCCESS;
+    }
+    if (!release) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(&g_timing, 0, sizeof(g_timing));
+    g_timing.entries = calloc(CONFIG_SIM_TIMING_MAX_PACKETS, sizeof(sim_timing_entry_t));
+    if (!g_timing.entries) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate timing calendar");
+        return STATUS_NO_MEMORY;
+    }
+    for (uint32_t i = 0; i < CONFIG_SIM_TIMING_MAX_PACKETS; i++) {
+        g_timing.entries[i].next = (i + 1 < CONFIG_SIM_TIMING_MAX_PACKETS) ? i + 2 : SIM_TIMING_NONE;
+    }
+    g_timing.free_head = 1;
+    g_timing.free_count = CONFIG_SIM_TIMING_MAX_PACKETS;
+    g_timing.release = release;
+    g_timing.rng = sim_timing_now_ns() | 1;
+    sim_timing_default_stages();
+
+    pthread_mutex_init(&g_timing.lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&g_timing.wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    g_timing.running = true;
+    if (pthread_create(&g_timing.thread, NULL, sim_timing_thread, NULL) != 0) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to start timing release thread");
+        pthread_cond_destroy(&g_timing.wake);
+        pthread_mutex_destroy(&g_timing.lock);
+        free(g_timing.entries);
+        g_timing.entries = NULL;
+        return STATUS_FAILURE;
+    }
+    pthread_setname_np(g_timing.thread, "asic-timing");
+
+    g_timing.initialized = true;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Stop the release thread and free the packets still scheduled
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t sim_timing_shutdown(void)
+{
+    if (!g_timing.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    pthread_mutex_lock(&g_timing.lock);
+    g_timing.enabled = false;
+    g_timing.running = false;
+    pthread_cond_signal(&g_timing.wake);
+    pthread_mutex_unlock(&g_timing.lock);
+    pthread_join(g_timing.thread, NULL);
+
+    /* Packets still scheduled never leave */
+    for (uint32_t b = 0; b < CONFIG_SIM_TIMING_BUCKETS; b++) {
+        for (uint32_t i = g_timing.head[b]; i != SIM_TIMING_NONE; i = g_timing.entries[i - 1].next) {
+            packet_buffer_free(g_timing.entries[i - 1].pkt);
+        }
+    }
+
+    pthread_cond_destroy(&g_timing.wake);
+    pthread_mutex_destroy(&g_timing.lock);
+    free(g_timing.entries);
+    g_timing.entries = NULL;
+    g_timing.initialized = false;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Enable or disable the model
+ *
+ * @param enable True to schedule packets, false to send them at once
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t sim_timing_enable(bool enable)
+{
+    if (!g_timing.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    __atomic_store_n(&g_timing.enabled, enable, __ATOMIC_RELAXED);
+    LOG_INFO(LOG_CATEGORY_HAL, "ASIC timing model %s", enable ? "enabled" : "disabled");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Check whether packets are scheduled
+ */
+bool sim_timing_enabled(void)
+{
+    return __atomic_load_n(&g_timing.enabled, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Set the latency of a stage
+ *
+ * @param stage Stage
+ * @param config Latency
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t sim_timing_set_stage(sim_timing_stage_t stage, const sim_timing_stage_config_t *config)
+{
+    if (!g_timing.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if ((uint32_t)stage >= SIM_TIMING_STAGE_COUNT || !config) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_timing.lock);
+    g_timing.stages[stage] = *config;
+    pthread_mutex_unlock(&g_timing.lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the latency of a stage
+ *
+ * @param stage Stage
+ * @param[out] config Latency
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t sim_timing_get_stage(sim_timing_stage_t stage, sim_timing_stage_config_t *config)
+{
+    if (!g_timing.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if ((uint32_t)stage >= SIM_TIMING_STAGE_COUNT || !config) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_timing.lock);
+    *config = g_timing.stages[stage];
+    pthread_mutex_unlock(&g_timing.lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Number of packets the calendar can still take
+ */
+uint32_t sim_timing_room(void)
+{
+    return __atomic_load_n(&g_timing.free_count, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Check whether a port has half the calendar horizon queued already
+ *
+ * @param port_id Egress port
+ * @return true if the port should take no more packets for now
+ */
+bool sim_timing_port_backlogged(port_id_t port_id)
+{
+    if (port_id >= MAX_PORTS) {
+        return false;
+    }
+
+    uint64_t busy_until_ps = __atomic_load_n(&g_timing.ports[port_id].busy_until_ps, __ATOMIC_RELAXED);
+    uint64_t limit_ps = (sim_timing_now_ns() + SIM_TIMING_HORIZON_NS / 2) * SIM_TIMING_PS_PER_NS;
+    return busy_until_ps > limit_ps;
+}
+
+/**
+ * @brief Schedule a burst of packets leaving a port
+ *
+ * @param port_id Egress port
+ * @param speed Port speed; PORT_SPEED_UNKNOWN adds no serialization delay
+ * @param pkts Packets, in the order they reach the egress
+ * @param count Number of packets
+ * @return Number of packets scheduled, a prefix of pkts
+ */
+uint32_t sim_timing_submit(port_id_t port_id, port_speed_t speed, packet_buffer_t **pkts,
+                           uint32_t count)
+{
+    if (!g_timing.initialized || port_id >= MAX_PORTS || !pkts) {
+        return 0;
+    }
+
+    sim_timing_port_t *port = &g_timing.ports[port_id];
+    uint64_t now_ns = sim_timing_now_ns();
+    uint64_t arrival_ps = now_ns * SIM_TIMING_PS_PER_NS;
+    uint32_t taken = 0;
+
+    pthread_mutex_lock(&g_timing.lock);
+
+    /* An empty calendar restarts at the present */
+    bool was_empty = (g_timing.scheduled == 0);
+    if (was_empty && g_timing.cursor < now_ns / CONFIG_SIM_TIMING_BUCKET_NS) {
+        g_timing.cursor = now_ns / CONFIG_SIM_TIMING_BUCKET_NS;
+    }
+
+    for (; taken < count && g_timing.free_head != SIM_TIMING_NONE; taken++) {
+        packet_buffer_t *pkt = pkts[taken];
+
+        packet_ensure_parsed(pkt);
+        uint32_t length = packet_chain_length(pkt);
+        uint64_t wire = (uint64_t)(length < SIM_TIMING_MIN_FRAME ? SIM_TIMING_MIN_FRAME : length) +
+                        SIM_TIMING_WIRE_OVERHEAD;
+
+        /* Through the pipeline, then wait for the wire, then onto it */
+        uint64_t start_ps = arrival_ps +
+                            sim_timing_pipeline_ps(packet_has_proto(pkt, PACKET_PROTO_IPV4 |
+                                                                         PACKET_PROTO_IPV6));
+        if (start_ps < port->busy_until_ps) {
+            start_ps = port->busy_until_ps;
+        }
+        uint64_t serialize_ps = (speed != PORT_SPEED_UNKNOWN) ?
+                                    wire * 8 * 1000000ULL / (uint64_t)speed : 0;
+        __atomic_store_n(&port->busy_until_ps, start_ps + serialize_ps, __ATOMIC_RELAXED);
+
+        uint64_t depart_ns = port->busy_until_ps / SIM_TIMING_PS_PER_NS;
+        uint64_t latency_ns = depart_ns - now_ns;
+
+        sim_timing_port_stats_t *stats = &port->stats;
+        if (stats->packets == 0 || latency_ns < stats->latency_min_ns) {
+            stats->latency_min_ns = latency_ns;
+        }
+        if (latency_ns > stats->latency_max_ns) {
+            stats->latency_max_ns = latency_ns;
+        }
+        if (stats->packets != 0) {
+            uint64_t delta = (latency_ns > port->last_latency_ns) ?
+                                 latency_ns - port->last_latency_ns :
+                                 port->last_latency_ns - latency_ns;
+            port->jitter_fp += delta - (port->jitter_fp >> SIM_TIMING_JITTER_SHIFT);
+        }
+        port->last_latency_ns = latency_ns;
+        stats->latency_total_ns += latency_ns;
+        stats->packets++;
+        stats->bytes += wire;
+        stats->pending++;
+
+        /* Into the bucket of its departure, or the last one the horizon allows */
+        uint64_t bucket = depart_ns / CONFIG_SIM_TIMING_BUCKET_NS;
+        if (bucket < g_timing.cursor) {
+            bucket = g_timing.cursor;
+        } else if (bucket >= g_timing.cursor + CONFIG_SIM_TIMING_BUCKETS) {
+            bucket = g_timing.cursor + CONFIG_SIM_TIMING_BUCKETS - 1;
+            stats->clamped++;
+        }
+
+        uint32_t index = g_timing.free_head;
+        sim_timing_entry_t *entry = &g_timing.entries[index - 1];
+        g_timing.free_head = entry->next;
+        entry->pkt = pkt;
+        entry->depart_ns = depart_ns;
+        entry->port_id = port_id;
+        entry->next = SIM_TIMING_NONE;
+
+        uint32_t slot = (uint32_t)(bucket & (CONFIG_SIM_TIMING_BUCKETS - 1));
+        if (g_timing.tail[slot] != SIM_TIMING_NONE) {
+            g_timing.entries[g_timing.tail[slot] - 1].next = index;
+        } else {
+            g_timing.head[slot] = index;
+        }
+        g_timing.tail[slot] = index;
+        g_timing.scheduled++;
+    }
+
+    __atomic_store_n(&g_timing.free_count, g_timing.free_count - taken, __ATOMIC_RELAXED);
+    if (was_empty && taken) {
+        pthread_cond_signal(&g_timing.wake);
+    }
+    pthread_mutex_unlock(&g_timing.lock);
+
+    return taken;
+}
+
+/**
+ * @brief Get the modeled timing of a port
+ *
+ * @param port_id Port
+ * @param[out] stats Timing
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t sim_timing_get_port_stats(port_id_t port_id, sim_timing_port_stats_t *stats)
+{
+    if (!g_timing.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (port_id >= MAX_PORTS || !stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_timing.lock);
+    *stats = g_timing.ports[port_id].stats;
+    stats->jitter_ns = g_timing.ports[port_id].jitter_fp >> SIM_TIMING_JITTER_SHIFT;
+    pthread_mutex_unlock(&g_timing.lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Reset the timing counters of a port; pending keeps counting
+ *
+ * @param port_id Port
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t sim_timing_clear_port_stats(port_id_t port_id)
+{
+    if (!g_timing.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (port_id >= MAX_PORTS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_timing.lock);
+    sim_timing_port_t *port = &g_timing.ports[port_id];
+    uint32_t pending = port->stats.pending;
+    memset(&port->stats, 0, sizeof(port->stats));
+    port->stats.pending = pending;
+    port->jitter_fp = 0;
+    pthread_mutex_unlock(&g_timing.lock);
+    return STATUS_SUCCESS;
+}
+
+/* Release thread */
+
+/**
+ * @brief Send a list of released entries and return them to the free list
+ *
+ * Called without the lock; consecutive packets of a port go out as one burst.
+ */
+static void sim_timing_send(uint32_t first)
+{
+    packet_buffer_t *burst[PACKET_BURST_MAX];
+    uint32_t n = 0;
+    port_id_t burst_port = 0;
+    uint32_t last = SIM_TIMING_NONE;
+    uint32_t released = 0;
+
+    for (uint32_t i = first; i != SIM_TIMING_NONE; i = g_timing.entries[i - 1].next) {
+        sim_timing_entry_t *entry = &g_timing.entries[i - 1];
+
+        if (n == PACKET_BURST_MAX || (n && entry->port_id != burst_port)) {
+            g_timing.release(burst_port, burst, n);
+            n = 0;
+        }
+        burst_port = entry->port_id;
+        burst[n++] = entry->pkt;
+        entry->pkt = NULL;
+        last = i;
+        released++;
+    }
+    if (n) {
+        g_timing.release(burst_port, burst, n);
+    }
+
+    pthread_mutex_lock(&g_timing.lock);
+    g_timing.entries[last - 1].next = g_timing.free_head;
+    g_timing.free_head = first;
+    __atomic_store_n(&g_timing.free_count, g_timing.free_count + released, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Release thread: sleeps until the next occupied bucket ends, then sends what is due
+ */
+static void *sim_timing_thread(void *arg)
+{
+    const uint32_t mask = CONFIG_SIM_TIMING_BUCKETS - 1;
+    struct timespec deadline;
+
+    (void)arg;
+
+    /* Wake-ups within a bucket of the deadline, not the default 50us slack */
+    prctl(PR_SET_TIMERSLACK, (unsigned long)CONFIG_SIM_TIMING_BUCKET_NS / 2, 0, 0, 0);
+
+    pthread_mutex_lock(&g_timing.lock);
+    while (g_timing.running) {
+        if (g_timing.scheduled == 0) {
+            pthread_cond_wait(&g_timing.wake, &g_timing.lock);
+            continue;
+        }
+
+        /* Entries never sit before the cursor nor a horizon past it */
+        while (g_timing.head[g_timing.cursor & mask] == SIM_TIMING_NONE) {
+            g_timing.cursor++;
+        }
+
+        uint64_t now = sim_timing_now_ns();
+        uint64_t due = (g_timing.cursor + 1) * CONFIG_SIM_TIMING_BUCKET_NS;
+        if (due > now) {
+            deadline.tv_sec = (time_t)(due / SIM_TIMING_NS_PER_SEC);
+            deadline.tv_nsec = (long)(due % SIM_TIMING_NS_PER_SEC);
+            pthread_cond_timedwait(&g_timing.wake, &g_timing.lock, &deadline);
+            continue;
+        }
+
+        /* Chain every bucket that has ended, in order */
+        uint32_t first = SIM_TIMING_NONE, last = SIM_TIMING_NONE;
+        while (g_timing.scheduled && (g_timing.cursor + 1) * CONFIG_SIM_TIMING_BUCKET_NS <= now) {
+            uint32_t slot = (uint32_t)(g_timing.cursor & mask);
+
+            for (uint32_t i = g_timing.head[slot]; i != SIM_TIMING_NONE; i = g_timing.entries[i - 1].next) {
+                sim_timing_entry_t *entry = &g_timing.entries[i - 1];
+                sim_timing_port_stats_t *stats = &g_timing.ports[entry->port_id].stats;
+                uint64_t late = (now > entry->depart_ns) ? now - entry->depart_ns : 0;
+
+                stats->released++;
+                stats->pending--;
+                stats->release_late_total_ns += late;
+                if (late > stats->release_late_max_ns) {
+                    stats->release_late_max_ns = late;
+                }
+                g_timing.scheduled--;
+            }
+            if (g_timing.head[slot] != SIM_TIMING_NONE) {
+                if (last != SIM_TIMING_NONE) {
+                    g_timing.entries[last - 1].next = g_timing.head[slot];
+                } else {
+                    first = g_timing.head[slot];
+                }
+                last = g_timing.tail[slot];
+                g_timing.head[slot] = g_timing.tail[slot] = SIM_TIMING_NONE;
+            }
+            g_timing.cursor++;
+        }
+        if (first == SIM_TIMING_NONE) {
+            continue;
+        }
+        pthread_mutex_unlock(&g_timing.lock);
+
+        /* Returns with the lock held */
+        sim_timing_send(first);
+    }
+    pthread_mutex_unlock(&g_timing.lock);
+
+    return NULL;
+}
@@ -0,0 +1,1392 @@
+/**
+ * @file topology.c
+ * @brief In-process multi-switch fabric implementation
+ *
+ * Switch s is switch instance s + 1; instance 0 stays the process's own
+ * switch. Port p of switch s receives through rx[p], whose only producer
+ * is the worker owning the peer switch (linked port) or the injectors of
+ * the switch, serialized by inject_lock (edge port). Its only consumer is
+ * the worker owning switch s.
+ *
+ * With a fabric clock each ring has a parallel array of arrival times, one
+ * per slot, written by the producer before it publishes the slot. Frames
+ * of one ring are in time order: a link has one latency and its sender
+ * sends in time order, and injections are stamped no earlier than the
+ * frames before them. A worker's window is a merge of its switch's rings
+ * up to the window end. The last worker at the barrier closes the window:
+ * the next one starts at the earliest frame any worker left on its rings
+ * or sent, or that was injected.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "../../include/hal/topology.h"
+#include "../../include/hal/packet_ring.h"
+#include "../../include/hal/packet_drop.h"
+#include "../../include/l2/lag.h"
+#include "../../include/l2/mac_table.h"
+#include "../../include/l2/mcast_snoop.h"
+#include "../../include/l2/vlan.h"
+#include "../../include/l2/vxlan.h"
+#include "../../include/common/bitmap.h"
+#include "../../include/common/config.h"
+#include "../../include/common/logging.h"
+#include "../../include/common/sim_clock.h"
+#include "../../include/common/switch_context.h"
+#include "../../include/common/threading.h"
+
+/**
+ * @brief Sleep between poll rounds that found no work (microseconds)
+ */
+#define TOPO_IDLE_SLEEP_US  50
+
+/**
+ * @brief Barrier polls before a waiting worker starts yielding the CPU
+ */
+#define TOPO_BARRIER_SPINS  256
+
+/**
+ * @brief No frame pending
+ */
+#define TOPO_TIME_NONE      UINT64_MAX
+
+/**
+ * @brief Interval of the LACP timer runs of a switch (milliseconds)
+ */
+#define TOPO_LACP_TICK_MS   100
+
+/**
+ * @brief One port of a switch
+ */
+typedef struct topo_port {
+    packet_ring_t *rx;                  /**< Frames received on the port */
+    uint64_t *arrival;                  /**< Fabric time of the frame in each slot of rx, with a fabric clock */
+    struct topo_port *peer;             /**< Linked port, NULL for an edge port */
+    uint64_t latency_ns;                /**< Latency of the link */
+    uint64_t inject_last_ns;            /**< Arrival time of the last frame injected (under inject_lock) */
+} topo_port_t;
+
+/**
+ * @brief One switch
+ */
+typedef struct {
+    uint32_t instance;                  /**< Switch instance */
+    topo_port_t *ports;                 /**< ports_per_switch ports */
+    spinlock_t inject_lock;             /**< Serializes producers of edge port rings */
+    uint32_t aged_at;                   /**< Simulator second of the last aging pass */
+    uint64_t lacp_next_ms;              /**< Next LACP timer run */
+    bool lacp_pending;                  /**< A LACPDU arrived since the last run */
+    topology_switch_stats_t stats;      /**< Counters (written by the owning worker only) */
+} topo_switch_t;
+
+/**
+ * @brief Worker thread state
+ */
+typedef struct {
+    pthread_t thread;                   /**< Thread handle */
+    uint32_t index;                     /**< Worker index */
+    bool started;                       /**< Thread was created */
+    int32_t cpu;                        /**< Pinned CPU, -1 if not pinned */
+    uint32_t *switches;                 /**< Switches owned by this worker */
+    uint32_t switch_count;              /**< Number of owned switches */
+    uint32_t sense;                     /**< Barrier phase the worker waits for */
+    uint64_t next_ns;                   /**< Earliest frame left by the worker's last window */
+} topo_worker_t;
+
+/**
+ * @brief Fabric clock state
+ */
+typedef struct {
+    bool synchronized;                  /**< Workers advance in time windows */
+    uint64_t lookahead_ns;              /**< Window length */
+    uint64_t start_ns;                  /**< Start of the current window */
+    uint64_t end_ns;                    /**< End of the current window, excluded */
+    uint64_t inject_min_ns;             /**< Earliest frame injected since the last window closed */
+    uint32_t epoch_s;                   /**< Simulator second at fabric time 0 */
+    bool idle;                          /**< No frame pending anywhere when the window closed */
+    uint64_t windows;                   /**< Windows run */
+    uint64_t skipped_ns;                /**< Fabric time jumped over */
+    volatile uint32_t arrived __attribute__((aligned(64))); /**< Workers at the barrier */
+    volatile uint32_t sense;            /**< Barrier phase, flipped by the last worker to arrive */
+} topo_clock_t;
+
+/**
+ * @brief Fabric state
+ */
+static struct {
+    bool initialized;
+    volatile bool running;
+    topology_config_t config;
+    topo_switch_t *switches;
+    topo_worker_t *workers;
+    uint32_t num_workers;
+    topology_deliver_fn deliver;
+    void *deliver_arg;
+    topo_clock_t clock;
+} g_topo = {0};
+
+/**
+ * @brief Fabric time of the frame a worker is processing
+ */
+static __thread uint64_t t_topo_now_ns;
+
+/**
+ * @brief Earliest arrival time of the frames a worker sent in its window
+ */
+static __thread uint64_t t_topo_sent_min_ns;
+
+/**
+ * @brief Calling thread is a topology worker
+ */
+static __thread bool t_topo_worker;
+
+/**
+ * @brief Put frames arriving at one time on a port's ring (producer side)
+ *
+ * The arrival times are written to the slots before the ring publishes
+ * them, and only to slots that are free.
+ *
+ * @param port Receiving port
+ * @param pkts Frames
+ * @param count Number of frames
+ * @param at_ns Fabric time of arrival
+ * @return Number of frames queued, a prefix of pkts
+ */
+static uint32_t topo_ring_put(topo_port_t *port, packet_buffer_t **pkts, uint32_t count, uint64_t at_ns) {
+    packet_ring_t *ring = port->rx;
+    uint32_t head = ring->head;
+    uint32_t space = ring->size - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+    uint32_t n = count < space ? count : space;
+
+    for (uint32_t i = 0; i < n; i++) {
+        port->arrival[(head + i) & ring->mask] = at_ns;
+    }
+    packet_ring_enqueue_burst(ring, pkts, n);
+    packet_ring_count_full(ring, count - n);
+    return n;
+}
+
+/**
+ * @brief Arrival time of the first frame on a port's ring (consumer side)
+ *
+ * @param port Receiving port
+ * @return Fabric time, TOPO_TIME_NONE if the ring is empty
+ */
+static inline uint64_t topo_ring_head_time(const topo_port_t *port) {
+    const packet_ring_t *ring = port->rx;
+    uint32_t tail = ring->tail;
+
+    if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail) {
+        return TOPO_TIME_NONE;
+    }
+    return port->arrival[tail & ring->mask];
+}
+
+/**
+ * @brief Send a frame out of a port
+ *
+ * @param sw Sending switch
+ * @param sw_index Index of the sending switch
+ * @param port_id Egress port
+ * @param packet Frame, consumed
+ */
+static void topo_transmit(topo_switch_t *sw, uint32_t sw_index, port_id_t port_id, packet_buffer_t *packet) {
+    topo_port_t *port = &sw->ports[port_id];
+    topo_port_t *peer = port->peer;
+
+    if (peer == NULL) {
+        sw->stats.delivered++;
+        if (g_topo.deliver) {
+            g_topo.deliver(sw_index, port_id, packet, g_topo.deliver_arg);
+        } else {
+            packet_buffer_free(packet);
+        }
+        return;
+    }
+
+    // The frame itself moves to the peer; its owner is now the peer's worker
+    if (g_topo.clock.synchronized) {
+        uint64_t at = t_topo_now_ns + port->latency_ns;
+        if (topo_ring_put(peer, &packet, 1, at) == 1) {
+            if (at < t_topo_sent_min_ns) {
+                t_topo_sent_min_ns = at;
+            }
+            return;
+        }
+    } else if (packet_ring_enqueue_burst(peer->rx, &packet, 1) == 1) {
+        return;
+    }
+
+    sw->stats.link_drops++;
+    packet_buffer_free(packet);
+}
+
+/**
+ * @brief Send shared copies of a frame out of every port of a bitmap
+ */
+static void topo_flood_group(topo_switch_t *sw, uint32_t sw_index, const vlan_port_bitmap_t *ports,
+                             const packet_buffer_t *packet) {
+    BITMAP_FOR_EACH(bit, ports->w, VLAN_PORT_WORDS) {
+        // A LAG floods out of one member
+        port_id_t port_id = lag_egress_port((port_id_t)bit, packet);
+        if (port_id >= g_topo.config.ports_per_switch) {
+            continue;
+        }
+        packet_buffer_t *copy = packet_buffer_clone_shared(packet);
+        if (copy) {
+            topo_transmit(sw, sw_index, port_id, copy);
+        }
+    }
+}
+
+/**
+ * @brief Send an encapsulated frame out of a tunnel's underlay port or LAG
+ */
+static void topo_transmit_underlay(port_id_t underlay_port, packet_buffer_t *packet, void *arg) {
+    topo_switch_t *sw = (topo_switch_t *)arg;
+    uint32_t sw_index = (uint32_t)(sw - g_topo.switches);
+    port_id_t tx_port = PORT_ID_INVALID;
+
+    // The member is chosen on the outer headers
+    if (!lag_port_is_lag(underlay_port) || packet_parse(packet) == STATUS_SUCCESS) {
+        tx_port = lag_egress_port(underlay_port, packet);
+    }
+    if (tx_port >= g_topo.config.ports_per_switch) {
+        sw->stats.dropped++;
+        packet_buffer_free(packet);
+        return;
+    }
+    topo_transmit(sw, sw_index, tx_port, packet);
+}
+
+/**
+ * @brief Flood a frame in its VLAN, to the ports of only if given
+ *
+ * Tunnels on the VLAN's flood list get encapsulated copies.
+ */
+static void topo_flood(topo_switch_t *sw, uint32_t sw_index, port_id_t in_port, packet_buffer_t *packet,
+                       vlan_id_t vlan_id, const vlan_port_bitmap_t *only) {
+    vlan_flood_t flood;
+
+    if (vlan_flood_prepare(packet, vlan_id, in_port, &flood) != STATUS_SUCCESS) {
+        sw->stats.dropped++;
+        packet_buffer_free(packet);
+        return;
+    }
+
+    if (only) {
+        bitmap_and(flood.tagged_ports.w, flood.tagged_ports.w, only->w, VLAN_PORT_WORDS);
+        bitmap_and(flood.untagged_ports.w, flood.untagged_ports.w, only->w, VLAN_PORT_WORDS);
+        bitmap_and(flood.translated_ports.w, flood.translated_ports.w, only->w, VLAN_PORT_WORDS);
+    }
+
+    if (flood.tagged) {
+        topo_flood_group(sw, sw_index, &flood.tagged_ports, flood.tagged);
+    }
+    if (flood.untagged) {
+        topo_flood_group(sw, sw_index, &flood.untagged_ports, flood.untagged);
+    }
+
+    // Translated ports each send the VLAN under their own VID
+    BITMAP_FOR_EACH(bit, flood.translated_ports.w, VLAN_PORT_WORDS) {
+        port_id_t port_id = (port_id_t)bit;
+        port_id_t tx_port = lag_egress_port(port_id, packet);
+        if (tx_port >= g_topo.config.ports_per_switch) {
+            continue;
+        }
+        packet_buffer_t *copy = packet_buffer_clone_shared(packet);
+        if (copy && vlan_process_egress_inplace(copy, vlan_id, port_id) == STATUS_SUCCESS) {
+            topo_transmit(sw, sw_index, tx_port, copy);
+        } else if (copy) {
+            packet_buffer_free(copy);
+        }
+    }
+
+    vxlan_flood(packet, vlan_id, in_port, topo_transmit_underlay, sw);
+
+    vlan_flood_release(&flood);
+    packet_buffer_free(packet);
+    sw->stats.flooded++;
+}
+
+/**
+ * @brief Current time of the LACP timers of a switch, in milliseconds
+ */
+static inline uint64_t topo_lacp_now_ms(void) {
+    return g_topo.clock.synchronized ? t_topo_now_ns / 1000000ULL : sim_clock_now_us() / 1000ULL;
+}
+
+/**
+ * @brief Send a LACPDU of the LAG module out of a port
+ */
+static void topo_lacp_transmit(port_id_t port_id, packet_buffer_t *packet, void *arg) {
+    topo_switch_t *sw = (topo_switch_t *)arg;
+
+    if (port_id >= g_topo.config.ports_per_switch) {
+        packet_buffer_free(packet);
+        return;
+    }
+    sw->stats.lacpdus_tx++;
+    topo_transmit(sw, (uint32_t)(sw - g_topo.switches), port_id, packet);
+}
+
+/**
+ * @brief Run the LACP timers of a switch when a tick has passed or a LACPDU asks for a reply
+ *
+ * Called bound to the switch's instance. With a fabric clock the timers
+ * run on fabric time, which stands still while the fabric is idle.
+ */
+static void topo_lacp_tick(topo_switch_t *sw) {
+    uint64_t now_ms = topo_lacp_now_ms();
+
+    if (now_ms < sw->lacp_next_ms && !sw->lacp_pending) {
+        return;
+    }
+    sw->lacp_next_ms = now_ms + TOPO_LACP_TICK_MS;
+    sw->lacp_pending = false;
+    lag_process_timers(now_ms, topo_lacp_transmit, sw);
+}
+
+/**
+ * @brief Send frames out of a port, in order
+ *
+ * A linked port takes the whole burst with one ring enqueue.
+ *
+ * @param sw Sending switch
+ * @param sw_index Index of the sending switch
+ * @param port_id Egress port
+ * @param pkts Frames, consumed
+ * @param count Number of frames
+ */
+static void topo_transmit_burst(topo_switch_t *sw, uint32_t sw_index, port_id_t port_id,
+                                packet_buffer_t **pkts, uint32_t count) {
+    topo_port_t *port = &sw->ports[port_id];
+    topo_port_t *peer = port->peer;
+    uint32_t sent;
+
+    if (peer == NULL) {
+        for (uint32_t i = 0; i < count; i++) {
+            topo_transmit(sw, sw_index, port_id, pkts[i]);
+        }
+        return;
+    }
+
+    if (g_topo.clock.synchronized) {
+        uint64_t at = t_topo_now_ns + port->latency_ns;
+        sent = topo_ring_put(peer, pkts, count, at);
+        if (sent > 0 && at < t_topo_sent_min_ns) {
+            t_topo_sent_min_ns = at;
+        }
+    } else {
+        sent = packet_ring_enqueue_burst(peer->rx, pkts, count);
+    }
+
+    sw->stats.link_drops += count - sent;
+    for (uint32_t i = sent; i < count; i++) {
+        packet_buffer_free(pkts[i]);
+    }
+}
+
+/**
+ * @brief Run a burst of frames received on one port through the L2 path of a switch
+ *
+ * The burst goes through the path in passes rather than frame by frame:
+ * every frame is classified first; the source addresses of the burst are
+ * then looked up in one bulk lookup and learned; the destinations are
+ * resolved in a second bulk lookup; known unicast is checked against the
+ * forwarding mask of its VLAN (members that are STP forwarding and
+ * link-up), read once per VLAN of the burst; and what leaves through a
+ * port is handed to it as one burst, in arrival order. Floods and tunnel
+ * encapsulations go out as they are met. Since all sources are learned
+ * before any destination is resolved, a frame to an address that a later
+ * frame of the burst comes from is forwarded rather than flooded.
+ *
+ * Frames of a LAG member are classified, learned and filtered as frames
+ * of the LAG; LACPDUs end here. VXLAN frames for the switch's VTEP are
+ * bridged as their inner frame, received on the tunnel in the VLAN of
+ * their VNI, and frames for a remote VTEP leave encapsulated. Called
+ * bound to the switch's instance.
+ *
+ * @param sw Receiving switch
+ * @param sw_index Index of the switch
+ * @param rx_port Port the frames arrived on
+ * @param pkts Frames, consumed
+ * @param count Number of frames, at most PACKET_BURST_MAX
+ */
+static void topo_switch_burst(topo_switch_t *sw, uint32_t sw_index, port_id_t rx_port,
+                              packet_buffer_t **pkts, uint32_t count) {
+    packet_buffer_t *frames[PACKET_BURST_MAX];
+    mac_addr_t src[PACKET_BURST_MAX];
+    mac_addr_t dst[PACKET_BURST_MAX];
+    vlan_id_t vlans[PACKET_BURST_MAX];
+    port_id_t in_ports[PACKET_BURST_MAX];
+    port_id_t out_ports[PACKET_BURST_MAX];
+    bool tunneled[PACKET_BURST_MAX];
+    mac_addr_t keys[PACKET_BURST_MAX];
+    vlan_id_t key_vlans[PACKET_BURST_MAX];
+    uint32_t key_frame[PACKET_BURST_MAX];
+    packet_buffer_t *tx[PACKET_BURST_MAX];
+    port_id_t tx_ports[PACKET_BURST_MAX];
+    uint32_t n = 0;
+    uint32_t keys_n = 0;
+    uint32_t tx_n = 0;
+    uint64_t hits = 0;
+
+    // Pass 1: classify
+    for (uint32_t i = 0; i < count; i++) {
+        packet_buffer_t *packet = pkts[i];
+        ethernet_header_t *eth;
+        port_id_t in_port;
+        vlan_id_t vlan_id = 0;
+        bool tunnel = false;
+        status_t status;
+
+        sw->stats.rx_packets++;
+        packet->metadata.port = rx_port;
+
+        if (packet_parse(packet) != STATUS_SUCCESS ||
+            packet_get_ethernet_header(packet, &eth) != STATUS_SUCCESS) {
+            sw->stats.dropped++;
+            packet_buffer_free(packet);
+            continue;
+        }
+
+        // Slow protocols frames are link-local, never bridged
+        if (lag_is_lacpdu(packet)) {
+            sw->stats.lacpdus_rx++;
+            if (lag_receive_lacpdu(rx_port, packet, topo_lacp_now_ms()) == STATUS_SUCCESS) {
+                sw->lacp_pending = true;
+            }
+            packet_buffer_free(packet);
+            continue;
+        }
+
+        in_port = lag_ingress_port(rx_port);
+        if (in_port == PORT_ID_INVALID) {
+            sw->stats.dropped++;
+            packet_buffer_free(packet);
+            continue;
+        }
+
+        status = vxlan_decap(packet, &in_port, &vlan_id);
+        if (status == STATUS_SUCCESS) {
+            tunnel = true;
+            packet_get_ethernet_header(packet, &eth);
+        } else if (status != STATUS_NOT_FOUND) {
+            sw->stats.dropped++;
+            packet_buffer_free(packet);
+            continue;
+        }
+
+        // Ingress retagging moves the header, keep the addresses
+        src[n] = eth->src_mac;
+        dst[n] = eth->dst_mac;
+
+        if (!tunnel && vlan_process_ingress_inplace(in_port, packet, &vlan_id) != STATUS_SUCCESS) {
+            sw->stats.dropped++;
+            packet_buffer_free(packet);
+            continue;
+        }
+
+        frames[n] = packet;
+        vlans[n] = vlan_id;
+        in_ports[n] = in_port;
+        tunneled[n] = tunnel;
+        n++;
+    }
+    if (n == 0) {
+        return;
+    }
+
+    // Pass 2: learn the unicast sources that are new or moved
+    for (uint32_t i = 0; i < n; i++) {
+        if ((src[i].addr[0] & 0x01) == 0) {
+            keys[keys_n] = src[i];
+            key_vlans[keys_n] = vlans[i];
+            key_frame[keys_n] = i;
+            keys_n++;
+        }
+    }
+    if (keys_n > 0 && mac_table_lookup_bulk(keys, key_vlans, keys_n, out_ports, &hits) == STATUS_SUCCESS) {
+        for (uint32_t k = 0; k < keys_n; k++) {
+            uint32_t i = key_frame[k];
+            if ((hits & (1ULL << k)) == 0 || out_ports[k] != in_ports[i]) {
+                mac_table_add(src[i], in_ports[i], vlans[i], false);
+            }
+        }
+    }
+
+    // Pass 3: resolve the unicast destinations
+    keys_n = 0;
+    hits = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        out_ports[i] = PORT_ID_INVALID;
+        if ((dst[i].addr[0] & 0x01) == 0) {
+            keys[keys_n] = dst[i];
+            key_vlans[keys_n] = vlans[i];
+            key_frame[keys_n] = i;
+            keys_n++;
+        }
+    }
+    if (keys_n > 0) {
+        port_id_t found[PACKET_BURST_MAX];
+        if (mac_table_lookup_bulk(keys, key_vlans, keys_n, found, &hits) == STATUS_SUCCESS) {
+            for (uint32_t k = 0; k < keys_n; k++) {
+                if (hits & (1ULL << k)) {
+                    out_ports[key_frame[k]] = found[k];
+                }
+            }
+        }
+    }
+
+    // Pass 4: egress
+    vlan_port_bitmap_t forwarding;
+    vlan_id_t forwarding_vlan = VLAN_ID_INVALID;
+    bool forwarding_valid = false;
+
+    for (uint32_t i = 0; i < n; i++) {
+        packet_buffer_t *packet = frames[i];
+        vlan_id_t vlan_id = vlans[i];
+        port_id_t in_port = in_ports[i];
+        port_id_t out_port = out_ports[i];
+        port_id_t tx_port;
+
+        if ((dst[i].addr[0] & 0x01) != 0) {
+            // Snooped groups go to their listeners and the router ports only
+            vlan_port_bitmap_t listeners;
+            bool snooped = mcast_snoop_process(packet, vlan_id, in_port, &listeners);
+            topo_flood(sw, sw_index, in_port, packet, vlan_id, snooped ? &listeners : NULL);
+            continue;
+        }
+
+        if (out_port == PORT_ID_INVALID ||
+            (out_port >= g_topo.config.ports_per_switch && !lag_port_is_lag(out_port) &&
+             !vxlan_port_is_tunnel(out_port))) {
+            topo_flood(sw, sw_index, in_port, packet, vlan_id, NULL);
+            continue;
+        }
+
+        // Split horizon: a tunnel's frames never go back into a tunnel
+        if (out_port == in_port || (tunneled[i] && vxlan_port_is_tunnel(out_port))) {
+            sw->stats.filtered++;
+            packet_buffer_free(packet);
+            continue;
+        }
+
+        if (vxlan_port_is_tunnel(out_port)) {
+            if (vxlan_encap(packet, out_port, vlan_id, &tx_port) != STATUS_SUCCESS) {
+                sw->stats.dropped++;
+                packet_buffer_free(packet);
+                continue;
+            }
+            sw->stats.forwarded++;
+            topo_transmit_underlay(tx_port, packet, sw);
+            continue;
+        }
+
+        // A blocked or down port forwards nothing; frames of a burst mostly share a VLAN
+        if (vlan_id != forwarding_vlan) {
+            forwarding_vlan = vlan_id;
+            forwarding_valid = vlan_get_flood_ports(vlan_id, PORT_ID_INVALID, &forwarding) == STATUS_SUCCESS;
+        }
+        if (!forwarding_valid ||
+            (out_port < VLAN_PORT_WORDS * 64 && !bitmap_test(forwarding.w, out_port))) {
+            sw->stats.filtered++;
+            packet_buffer_free(packet);
+            continue;
+        }
+
+        // The member is chosen on the headers as received, before egress retagging
+        tx_port = lag_egress_port(out_port, packet);
+        if (tx_port >= g_topo.config.ports_per_switch ||
+            vlan_process_egress_inplace(packet, vlan_id, out_port) != STATUS_SUCCESS) {
+            sw->stats.dropped++;
+            packet_buffer_free(packet);
+            continue;
+        }
+
+        sw->stats.forwarded++;
+        tx[tx_n] = packet;
+        tx_ports[tx_n] = tx_port;
+        tx_n++;
+    }
+
+    // Pass 5: one burst per egress port, ports in the order first used
+    for (uint32_t i = 0; i < tx_n; i++) {
+        port_id_t port_id = tx_ports[i];
+        packet_buffer_t *group[PACKET_BURST_MAX];
+        uint32_t group_n = 0;
+
+        if (port_id == PORT_ID_INVALID) {
+            continue;
+        }
+        for (uint32_t j = i; j < tx_n; j++) {
+            if (tx_ports[j] == port_id) {
+                group[group_n++] = tx[j];
+                tx_ports[j] = PORT_ID_INVALID;
+            }
+        }
+        topo_transmit_burst(sw, sw_index, port_id, group, group_n);
+    }
+}
+
+/**
+ * @brief Worker thread main loop
+ *
+ * @param arg Worker state
+ * @return NULL
+ */
+static void *topo_worker_main(void *arg) {
+    topo_worker_t *worker = (topo_worker_t *)arg;
+    packet_buffer_t *pkts[PACKET_BURST_MAX];
+
+    LOG_INFO(LOG_CATEGORY_HAL, "Topology worker %u started (%u switches, cpu %d)",
+             worker->index, worker->switch_count, worker->cpu);
+
+    while (__atomic_load_n(&g_topo.running, __ATOMIC_ACQUIRE)) {
+        uint64_t work = 0;
+        uint32_t now = (uint32_t)sim_clock_time();
+
+        for (uint32_t i = 0; i < worker->switch_count; i++) {
+            uint32_t sw_index = worker->switches[i];
+            topo_switch_t *sw = &g_topo.switches[sw_index];
+
+            switch_context_bind(sw->instance);
+
+            for (port_id_t p = 0; p < g_topo.config.ports_per_switch; p++) {
+                uint32_t n = packet_ring_dequeue_burst(sw->ports[p].rx, pkts, PACKET_BURST_MAX);
+                if (n > 0) {
+                    topo_switch_burst(sw, sw_index, p, pkts, n);
+                }
+                work += n;
+            }
+
+            if (now != sw->aged_at) {
+                sw->aged_at = now;
+                mac_table_process_aging((mac_table_t *)mac_table_get_instance(), now);
+                mcast_snoop_process_timers(now);
+            }
+            topo_lacp_tick(sw);
+        }
+
+        if (work == 0) {
+            usleep(TOPO_IDLE_SLEEP_US);
+        }
+    }
+
+    switch_context_bind(SWITCH_INSTANCE_DEFAULT);
+    LOG_INFO(LOG_CATEGORY_HAL, "Topology worker %u stopped", worker->index);
+    return NULL;
+}
+
+/**
+ * @brief Close the window and open the next one; run by the last worker at the barrier
+ */
+static void topo_clock_advance(void) {
+    topo_clock_t *clock = &g_topo.clock;
+    uint64_t next = __atomic_exchange_n(&clock->inject_min_ns, TOPO_TIME_NONE, __ATOMIC_ACQ_REL);
+
+    for (uint32_t w = 0; w < g_topo.num_workers; w++) {
+        if (g_topo.workers[w].next_ns < next) {
+            next = g_topo.workers[w].next_ns;
+        }
+    }
+
+    clock->idle = (next == TOPO_TIME_NONE);
+    if (clock->idle) {
+        // An empty window at the end; frames injected meanwhile are stamped with it
+        __atomic_store_n(&clock->start_ns, clock->end_ns, __ATOMIC_RELEASE);
+        return;
+    }
+
+    // Injections racing the previous window may be stamped before its end
+    if (next < clock->end_ns) {
+        next = clock->end_ns;
+    }
+    clock->skipped_ns += next - clock->end_ns;
+    clock->windows++;
+    __atomic_store_n(&clock->start_ns, next, __ATOMIC_RELEASE);
+    __atomic_store_n(&clock->end_ns, next + clock->lookahead_ns, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Wait for all workers to finish their window
+ *
+ * Sense-reversing barrier; the last worker to arrive opens the next window
+ * before it lets the others go.
+ *
+ * @param worker Calling worker
+ * @return false if the fabric is stopping
+ */
+static bool topo_clock_barrier(topo_worker_t *worker) {
+    topo_clock_t *clock = &g_topo.clock;
+    uint32_t sense = worker->sense ^ 1;
+
+    worker->sense = sense;
+    if (__atomic_add_fetch(&clock->arrived, 1, __ATOMIC_ACQ_REL) == g_topo.num_workers) {
+        topo_clock_advance();
+        __atomic_store_n(&clock->arrived, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&clock->sense, sense, __ATOMIC_RELEASE);
+        return __atomic_load_n(&g_topo.running, __ATOMIC_ACQUIRE);
+    }
+
+    for (uint32_t spins = 0; __atomic_load_n(&clock->sense, __ATOMIC_ACQUIRE) != sense; spins++) {
+        // A worker that left for shutdown never arrives
+        if (!__atomic_load_n(&g_topo.running, __ATOMIC_ACQUIRE)) {
+            return false;
+        }
+        if (spins < TOPO_BARRIER_SPINS) {
+#if defined(__x86_64__) || defined(__i386__)
+            __asm__ volatile("pause" ::: "memory");
+#elif defined(__arm__) || defined(__aarch64__)
+            __asm__ volatile("yield" ::: "memory");
+#endif
+        } else {
+            sched_yield();
+        }
+    }
+    return __atomic_load_n(&g_topo.running, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Process the frames of one switch that arrive before the window end
+ *
+ * Frames of all ports are taken in time order, ties by port. Called bound
+ * to the switch's instance.
+ *
+ * @return Arrival time of the first frame left on the switch's rings
+ */
+static uint64_t topo_switch_window(topo_switch_t *sw, uint32_t sw_index, uint64_t start_ns, uint64_t end_ns) {
+    packet_buffer_t *packet;
+
+    for (;;) {
+        uint64_t first = TOPO_TIME_NONE;
+        port_id_t in_port = 0;
+
+        for (port_id_t p = 0; p < g_topo.config.ports_per_switch; p++) {
+            uint64_t at = topo_ring_head_time(&sw->ports[p]);
+            if (at < first) {
+                first = at;
+                in_port = p;
+            }
+        }
+        if (first == TOPO_TIME_NONE || first >= end_ns) {
+            return first;
+        }
+
+        packet_ring_dequeue_burst(sw->ports[in_port].rx, &packet, 1);
+        t_topo_now_ns = first > start_ns ? first : start_ns;
+        topo_switch_burst(sw, sw_index, in_port, &packet, 1);
+    }
+}
+
+/**
+ * @brief Worker thread main loop with a fabric clock
+ *
+ * @param arg Worker state
+ * @return NULL
+ */
+static void *topo_worker_clock_main(void *arg) {
+    topo_worker_t *worker = (topo_worker_t *)arg;
+    topo_clock_t *clock = &g_topo.clock;
+
+    LOG_INFO(LOG_CATEGORY_HAL, "Topology worker %u started (%u switches, cpu %d, lookahead %llu ns)",
+             worker->index, worker->switch_count, worker->cpu, (unsigned long long)clock->lookahead_ns);
+    t_topo_worker = true;
+
+    do {
+        uint64_t start = __atomic_load_n(&clock->start_ns, __ATOMIC_ACQUIRE);
+        uint64_t end = __atomic_load_n(&clock->end_ns, __ATOMIC_ACQUIRE);
+        uint64_t next = TOPO_TIME_NONE;
+
+        if (clock->idle) {
+            usleep(TOPO_IDLE_SLEEP_US);
+        }
+
+        t_topo_sent_min_ns = TOPO_TIME_NONE;
+        for (uint32_t i = 0; i < worker->switch_count; i++) {
+            uint32_t sw_index = worker->switches[i];
+            topo_switch_t *sw = &g_topo.switches[sw_index];
+            uint32_t now = clock->epoch_s + (uint32_t)(start / 1000000000ULL);
+
+            switch_context_bind(sw->instance);
+            if (now != sw->aged_at) {
+                sw->aged_at = now;
+                mac_table_process_aging((mac_table_t *)mac_table_get_instance(), now);
+                mcast_snoop_process_timers(now);
+            }
+
+            // LACPDUs go out at the window start, so they arrive at or after its end
+            t_topo_now_ns = start;
+            topo_lacp_tick(sw);
+
+            uint64_t left = topo_switch_window(sw, sw_index, start, end);
+            if (left < next) {
+                next = left;
+            }
+        }
+        worker->next_ns = next < t_topo_sent_min_ns ? next : t_topo_sent_min_ns;
+    } while (topo_clock_barrier(worker));
+
+    switch_context_bind(SWITCH_INSTANCE_DEFAULT);
+    t_topo_worker = false;
+    LOG_INFO(LOG_CATEGORY_HAL, "Topology worker %u stopped", worker->index);
+    return NULL;
+}
+
+/**
+ * @brief Stop and join the started workers
+ */
+static void topo_stop_workers(void) {
+    __atomic_store_n(&g_topo.running, false, __ATOMIC_RELEASE);
+    for (uint32_t w = 0; w < g_topo.num_workers; w++) {
+        if (g_topo.workers[w].started) {
+            pthread_join(g_topo.workers[w].thread, NULL);
+            g_topo.workers[w].started = false;
+        }
+    }
+}
+
+/**
+ * @brief Free the rings and instance state of all switches and the workers
+ */
+static void topo_free(void) {
+    packet_buffer_t *pkts[PACKET_BURST_MAX];
+
+    if (g_topo.switches) {
+        for (uint32_t s = 0; s < g_topo.config.num_switches; s++) {
+            topo_switch_t *sw = &g_topo.switches[s];
+            if (!sw->ports) {
+                continue;
+            }
+            for (uint32_t p = 0; p < g_topo.config.ports_per_switch; p++) {
+                if (!sw->ports[p].rx) {
+                    continue;
+                }
+                uint32_t n;
+                while ((n = packet_ring_dequeue_burst(sw->ports[p].rx, pkts, PACKET_BURST_MAX)) > 0) {
+                    for (uint32_t k = 0; k < n; k++) {
+                        packet_buffer_free(pkts[k]);
+                    }
+                }
+                packet_ring_destroy(sw->ports[p].rx);
+                free(sw->ports[p].arrival);
+            }
+            free(sw->ports);
+
+            if (sw->instance != SWITCH_INSTANCE_DEFAULT) {
+                switch_context_bind(sw->instance);
+                vxlan_deinit();
+                mcast_snoop_deinit();
+                lag_deinit();
+                vlan_deinit();
+                mac_table_deinit();
+            }
+        }
+        switch_context_bind(SWITCH_INSTANCE_DEFAULT);
+        free(g_topo.switches);
+        g_topo.switches = NULL;
+    }
+
+    if (g_topo.workers) {
+        for (uint32_t w = 0; w < g_topo.num_workers; w++) {
+            free(g_topo.workers[w].switches);
+        }
+        free(g_topo.workers);
+        g_topo.workers = NULL;
+    }
+    g_topo.num_workers = 0;
+}
+
+/**
+ * @brief Fill a configuration with defaults
+ *
+ * @param[out] config Configuration to fill
+ */
+void topology_get_default_config(topology_config_t *config) {
+    if (!config) {
+        return;
+    }
+
+    config->num_switches = 2;
+    config->ports_per_switch = CONFIG_TOPOLOGY_PORTS;
+    config->num_workers = CONFIG_WORKER_THREADS;
+    config->ring_size = CONFIG_TOPOLOGY_RING_SIZE;
+    config->mac_table_size = CONFIG_TOPOLOGY_MAC_TABLE_SIZE;
+    config->pin_workers = false;
+    config->link_latency_ns = CONFIG_TOPOLOGY_LINK_LATENCY_NS;
+}
+
+/**
+ * @brief Create the switches and their port rings
+ *
+ * @param config Configuration
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t topology_init(const topology_config_t *config) {
+    status_t status;
+
+    if (g_topo.initialized) {
+        LOG_WARNING(LOG_CATEGORY_HAL, "Topology already initialized");
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    if (!config || config->num_switches == 0 || config->num_switches >= CONFIG_MAX_SWITCH_INSTANCES ||
+        config->ports_per_switch == 0 || config->ports_per_switch > CONFIG_LAG_PORT_BASE ||
+        config->ring_size == 0 || (config->ring_size & (config->ring_size - 1)) != 0) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Invalid topology configuration");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t cpus = online > 0 ? (uint32_t)online : 1;
+    uint32_t num_workers = config->num_workers ? config->num_workers : cpus;
+    if (num_workers > CONFIG_MAX_WORKER_THREADS) {
+        num_workers = CONFIG_MAX_WORKER_THREADS;
+    }
+    if (num_workers > config->num_switches) {
+        num_workers = config->num_switches;
+    }
+
+    g_topo.config = *config;
+    g_topo.num_workers = num_workers;
+    g_topo.switches = (topo_switch_t *)calloc(config->num_switches, sizeof(topo_switch_t));
+    g_topo.workers = (topo_worker_t *)calloc(num_workers, sizeof(topo_worker_t));
+    if (!g_topo.switches || !g_topo.workers) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate topology");
+        topo_free();
+        return STATUS_NO_MEMORY;
+    }
+
+    for (uint32_t s = 0; s < config->num_switches; s++) {
+        topo_switch_t *sw = &g_topo.switches[s];
+
+        sw->ports = (topo_port_t *)calloc(config->ports_per_switch, sizeof(topo_port_t));
+        if (!sw->ports) {
+            LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate ports of switch %u", s);
+            topo_free();
+            return STATUS_NO_MEMORY;
+        }
+        for (uint32_t p = 0; p < config->ports_per_switch; p++) {
+            sw->ports[p].rx = packet_ring_create(config->ring_size);
+            if (config->link_latency_ns) {
+                sw->ports[p].arrival = (uint64_t *)calloc(config->ring_size, sizeof(uint64_t));
+            }
+            if (!sw->ports[p].rx || (config->link_latency_ns && !sw->ports[p].arrival)) {
+                LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate ring of switch %u port %u", s, p);
+                topo_free();
+                return STATUS_NO_MEMORY;
+            }
+        }
+        spinlock_init(&sw->inject_lock);
+
+        switch_context_bind(s + 1);
+        status = vlan_init(config->ports_per_switch);
+        if (status == STATUS_SUCCESS) {
+            status = mac_table_init(config->mac_table_size, 0);
+            if (status != STATUS_SUCCESS) {
+                vlan_deinit();
+            }
+        }
+        if (status == STATUS_SUCCESS) {
+            status = lag_init();
+            if (status != STATUS_SUCCESS) {
+                mac_table_deinit();
+                vlan_deinit();
+            }
+        }
+        if (status == STATUS_SUCCESS) {
+            status = mcast_snoop_init(0);
+            if (status != STATUS_SUCCESS) {
+                lag_deinit();
+                mac_table_deinit();
+                vlan_deinit();
+            }
+        }
+        if (status == STATUS_SUCCESS) {
+            status = vxlan_init();
+            if (status != STATUS_SUCCESS) {
+                mcast_snoop_deinit();
+                lag_deinit();
+                mac_table_deinit();
+                vlan_deinit();
+            }
+        }
+        if (status == STATUS_SUCCESS) {
+            // Entries are stamped with the table's time, set it before any learning
+            sw->aged_at = (uint32_t)sim_clock_time();
+            mac_table_process_aging((mac_table_t *)mac_table_get_instance(), sw->aged_at);
+        }
+        switch_context_bind(SWITCH_INSTANCE_DEFAULT);
+        if (status != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_HAL, "Failed to initialize switch %u: %d", s, status);
+            topo_free();
+            return status;
+        }
+        sw->instance = s + 1;
+    }
+
+    // Switches go to workers round-robin
+    for (uint32_t w = 0; w < num_workers; w++) {
+        g_topo.workers[w].index = w;
+        g_topo.workers[w].cpu = -1;
+        g_topo.workers[w].switches = (uint32_t *)calloc(config->num_switches / num_workers + 1, sizeof(uint32_t));
+        if (!g_topo.workers[w].switches) {
+            LOG_ERROR(LOG_CATEGORY_HAL, "Failed to allocate topology worker %u", w);
+            topo_free();
+            return STATUS_NO_MEMORY;
+        }
+    }
+    for (uint32_t s = 0; s < config->num_switches; s++) {
+        topo_worker_t *worker = &g_topo.workers[s % num_workers];
+        worker->switches[worker->switch_count++] = s;
+    }
+
+    g_topo.deliver = NULL;
+    g_topo.deliver_arg = NULL;
+    memset(&g_topo.clock, 0, sizeof(g_topo.clock));
+    g_topo.clock.synchronized = config->link_latency_ns != 0;
+    g_topo.clock.lookahead_ns = config->link_latency_ns;
+    g_topo.clock.inject_min_ns = TOPO_TIME_NONE;
+    g_topo.clock.epoch_s = (uint32_t)sim_clock_time();
+    g_topo.initialized = true;
+
+    LOG_INFO(LOG_CATEGORY_HAL, "Topology of %u switches with %u ports created (%u workers, %s)",
+             config->num_switches, config->ports_per_switch, num_workers,
+             g_topo.clock.synchronized ? "fabric clock" : "free running");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Stop the workers and release the switches
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t topology_shutdown(void) {
+    if (!g_topo.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    topo_stop_workers();
+    topo_free();
+    g_topo.initialized = false;
+
+    LOG_INFO(LOG_CATEGORY_HAL, "Topology released");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Connect two ports with a given latency
+ */
+static status_t topo_connect(uint32_t sw_a, port_id_t port_a, uint32_t sw_b, port_id_t port_b,
+                             uint64_t latency_ns) {
+    if (!g_topo.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (__atomic_load_n(&g_topo.running, __ATOMIC_ACQUIRE)) {
+        return STATUS_RESOURCE_BUSY;
+    }
+
+    if (sw_a >= g_topo.config.num_switches || sw_b >= g_topo.config.num_switches ||
+        port_a >= g_topo.config.ports_per_switch || port_b >= g_topo.config.ports_per_switch ||
+        (sw_a == sw_b && port_a == port_b)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    topo_port_t *a = &g_topo.switches[sw_a].ports[port_a];
+    topo_port_t *b = &g_topo.switches[sw_b].ports[port_b];
+    if (a->peer || b->peer) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Port already linked: %u/%u or %u/%u", sw_a, port_a, sw_b, port_b);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    a->peer = b;
+    b->peer = a;
+    a->latency_ns = latency_ns;
+    b->latency_ns = latency_ns;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Connect two ports
+ *
+ * @param sw_a First switch
+ * @param port_a Port of the first switch
+ * @param sw_b Second switch
+ * @param port_b Port of the second switch
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t topology_link(uint32_t sw_a, port_id_t port_a, uint32_t sw_b, port_id_t port_b) {
+    return topo_connect(sw_a, port_a, sw_b, port_b, g_topo.config.link_latency_ns);
+}
+
+/**
+ * @brief Connect two ports with a link of its own latency
+ *
+ * @param sw_a First switch
+ * @param port_a Port of the first switch
+ * @param sw_b Second switch
+ * @param port_b Port of the second switch
+ * @param latency_ns Link latency, nonzero
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t topology_link_latency(uint32_t sw_a, port_id_t port_a, uint32_t sw_b, port_id_t port_b,
+                               uint64_t latency_ns) {
+    if (!g_topo.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (!g_topo.clock.synchronized) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    if (latency_ns == 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    return topo_connect(sw_a, port_a, sw_b, port_b, latency_ns);
+}
+
+/**
+ * @brief Set the function that takes frames sent out of edge ports
+ *
+ * @param deliver Callback, may be NULL
+ * @param arg Callback argument
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t topology_set_deliver(topology_deliver_fn deliver, void *arg) {
+    if (!g_topo.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (__atomic_load_n(&g_topo.running, __ATOMIC_ACQUIRE)) {
+        return STATUS_RESOURCE_BUSY;
+    }
+
+    g_topo.deliver = deliver;
+    g_topo.deliver_arg = arg;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Start the worker threads
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t topology_start(void) {
+    if (!g_topo.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (__atomic_load_n(&g_topo.running, __ATOMIC_ACQUIRE)) {
+        return STATUS_RESOURCE_BUSY;
+    }
+
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t cpus = online > 0 ? (uint32_t)online : 1;
+    void *(*worker_main)(void *) = topo_worker_main;
+
+    if (g_topo.clock.synchronized) {
+        // The lookahead is the shortest link
+        uint64_t lookahead = g_topo.config.link_latency_ns;
+        for (uint32_t s = 0; s < g_topo.config.num_switches; s++) {
+            for (uint32_t p = 0; p < g_topo.config.ports_per_switch; p++) {
+                topo_port_t *port = &g_topo.switches[s].ports[p];
+                if (port->peer && port->latency_ns < lookahead) {
+                    lookahead = port->latency_ns;
+                }
+            }
+        }
+        g_topo.clock.lookahead_ns = lookahead;
+        g_topo.clock.arrived = 0;
+        g_topo.clock.sense = 0;
+        for (uint32_t w = 0; w < g_topo.num_workers; w++) {
+            g_topo.workers[w].sense = 0;
+            g_topo.workers[w].next_ns = TOPO_TIME_NONE;
+        }
+        worker_main = topo_worker_clock_main;
+    }
+
+    __atomic_store_n(&g_topo.running, true, __ATOMIC_RELEASE);
+    for (uint32_t w = 0; w < g_topo.num_workers; w++) {
+        topo_worker_t *worker = &g_topo.workers[w];
+        int rc = -1;
+
+        if (g_topo.config.pin_workers) {
+            pthread_attr_t attr;
+            cpu_set_t set;
+
+            worker->cpu = (int32_t)(w % cpus);
+            CPU_ZERO(&set);
+            CPU_SET(worker->cpu, &set);
+            pthread_attr_init(&attr);
+            if (pthread_attr_setaffinity_np(&attr, sizeof(set), &set) == 0) {
+                rc = pthread_create(&worker->thread, &attr, worker_main, worker);
+            }
+            pthread_attr_destroy(&attr);
+
+            if (rc != 0) {
+                LOG_WARNING(LOG_CATEGORY_HAL, "Failed to pin topology worker %u to cpu %d", w, worker->cpu);
+                worker->cpu = -1;
+            }
+        }
+
+        if (rc != 0) {
+            rc = pthread_create(&worker->thread, NULL, worker_main, worker);
+        }
+
+        if (rc != 0) {
+            LOG_ERROR(LOG_CATEGORY_HAL, "Failed to start topology worker %u", w);
+            topo_stop_workers();
+            return STATUS_FAILURE;
+        }
+        worker->started = true;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Switch instance of a switch
+ *
+ * @param sw Switch index
+ * @return Instance number, SWITCH_INSTANCE_DEFAULT for a bad index
+ */
+uint32_t topology_instance(uint32_t sw) {
+    if (!g_topo.initialized || sw >= g_topo.config.num_switches) {
+        return SWITCH_INSTANCE_DEFAULT;
+    }
+    return g_topo.switches[sw].instance;
+}
+
+/**
+ * @brief Inject frames into an edge port
+ *
+ * @param sw Switch index
+ * @param port_id Edge port
+ * @param pkts Frames
+ * @param count Number of frames
+ * @return Number of frames taken
+ */
+uint32_t topology_inject(uint32_t sw, port_id_t port_id, packet_buffer_t **pkts, uint32_t count) {
+    return topology_inject_at(sw, port_id, pkts, count, 0);
+}
+
+/**
+ * @brief Inject frames into an edge port at a fabric time
+ *
+ * @param sw Switch index
+ * @param port_id Edge port
+ * @param pkts Frames
+ * @param count Number of frames
+ * @param at_ns Fabric time of arrival
+ * @return Number of frames taken
+ */
+uint32_t topology_inject_at(uint32_t sw, port_id_t port_id, packet_buffer_t **pkts, uint32_t count,
+                            uint64_t at_ns) {
+    uint32_t queued;
+
+    if (!g_topo.initialized || !pkts || sw >= g_topo.config.num_switches ||
+        port_id >= g_topo.config.ports_per_switch) {
+        return 0;
+    }
+
+    topo_switch_t *s = &g_topo.switches[sw];
+    topo_port_t *port = &s->ports[port_id];
+    if (port->peer) {
+        // The peer's worker is the ring's producer
+        return 0;
+    }
+
+    spinlock_acquire(&s->inject_lock);
+    if (g_topo.clock.synchronized) {
+        // Not before the open window ends, nor before the port's earlier frames
+        uint64_t horizon = __atomic_load_n(&g_topo.clock.end_ns, __ATOMIC_ACQUIRE);
+        if (at_ns < horizon) {
+            at_ns = horizon;
+        }
+        if (at_ns < port->inject_last_ns) {
+            at_ns = port->inject_last_ns;
+        }
+        queued = topo_ring_put(port, pkts, count, at_ns);
+        if (queued) {
+            port->inject_last_ns = at_ns;
+        }
+    } else {
+        queued = packet_ring_enqueue_burst(port->rx, pkts, count);
+    }
+    spinlock_release(&s->inject_lock);
+
+    if (queued && g_topo.clock.synchronized) {
+        uint64_t min = __atomic_load_n(&g_topo.clock.inject_min_ns, __ATOMIC_RELAXED);
+        while (at_ns < min &&
+               !__atomic_compare_exchange_n(&g_topo.clock.inject_min_ns, &min, at_ns, true,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        }
+    }
+    return queued;
+}
+
+/**
+ * @brief Current fabric time
+ *
+ * @return Fabric time in nanoseconds
+ */
+uint64_t topology_now_ns(void) {
+    if (!g_topo.initialized || !g_topo.clock.synchronized) {
+        return 0;
+    }
+    if (t_topo_worker) {
+        return t_topo_now_ns;
+    }
+    return __atomic_load_n(&g_topo.clock.start_ns, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Get the state of the fabric clock
+ *
+ * @param[out] stats Clock state
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t topology_get_clock_stats(topology_clock_stats_t *stats) {
+    if (!g_topo.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    stats->synchronized = g_topo.clock.synchronized;
+    stats->now_ns = __atomic_load_n(&g_topo.clock.start_ns, __ATOMIC_ACQUIRE);
+    stats->lookahead_ns = g_topo.clock.lookahead_ns;
+    stats->windows = __atomic_load_n(&g_topo.clock.windows, __ATOMIC_RELAXED);
+    stats->skipped_ns = __atomic_load_n(&g_topo.clock.skipped_ns, __ATOMIC_RELAXED);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the counters of a switch
+ *
+ * @param sw Switch index
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t topology_get_switch_stats(uint32_t sw, topology_switch_stats_t *stats) {
+    if (!g_topo.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (!stats || sw >= g_topo.config.num_switches) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    *stats = g_topo.switches[sw].stats;
+    return STATUS_SUCCESS;
+}
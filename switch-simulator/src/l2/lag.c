@@ -0,0 +1,1104 @@
+/**
+ * @file lag.c
+ * @brief Implementation of link aggregation groups and LACP
+ *
+ * Forwarding reads two things without a lock. The member word of a port
+ * (member_of) says which LAG it belongs to and whether it collects; it is
+ * one 16-bit store per change. The distribution table of a LAG lists the
+ * members that distribute; it is immutable once published, replaced with
+ * one pointer exchange and freed through RCU, so a sender sees either the
+ * table before a failover or the one after, never a mix.
+ *
+ * Everything else, the LACP state of members included, is written under
+ * the module lock. The protocol follows 802.1AX with the selection and
+ * mux machines collapsed into lag_update(): a member is selected when its
+ * link is up and its partner is the partner of the LAG, it is in sync
+ * once selected, and it collects and distributes once the partner says
+ * it is in sync too.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/config.h"
+#include "common/logging.h"
+#include "common/threading.h"
+#include "common/rcu.h"
+#include "common/bitmap.h"
+#include "common/switch_context.h"
+#include "hal/port.h"
+#include "hal/link_event.h"
+#include "l2/lag.h"
+
+/**
+ * @brief Member word of a port: LAG_MEMBER_VALID | LAG_MEMBER_COLLECTING | LAG index
+ */
+#define LAG_MEMBER_VALID        0x8000
+#define LAG_MEMBER_COLLECTING   0x4000
+#define LAG_MEMBER_INDEX_MASK   0x0FFF
+
+/**
+ * @brief Slow protocols frame layout
+ */
+#define LAG_ETH_HDR_LEN         14
+#define LAG_ETH_ADDRS_LEN       (2 * MAC_ADDR_LEN)
+#define LACP_SUBTYPE            1
+#define LACP_VERSION            1
+#define LACP_PDU_LEN            110     /**< Subtype through the trailing reserved octets */
+#define LACP_PDU_MIN_LEN        42      /**< Subtype through the partner TLV */
+#define LACP_FRAME_LEN          (LAG_ETH_HDR_LEN + LACP_PDU_LEN)
+#define LACP_TLV_ACTOR          1
+#define LACP_TLV_PARTNER        2
+#define LACP_TLV_COLLECTOR      3
+#define LACP_TLV_INFO_LEN       20
+#define LACP_TLV_COLLECTOR_LEN  16
+
+/**
+ * @brief LACP timers (milliseconds)
+ */
+#define LACP_FAST_PERIODIC_MS   1000
+#define LACP_SLOW_PERIODIC_MS   30000
+#define LACP_SHORT_TIMEOUT_MS   (3 * LACP_FAST_PERIODIC_MS)
+#define LACP_LONG_TIMEOUT_MS    (3 * LACP_SLOW_PERIODIC_MS)
+
+#define LACP_DEFAULT_SYSTEM_PRIORITY 0x8000
+#define LACP_DEFAULT_PORT_PRIORITY   0x8000
+
+static const uint8_t g_lacp_dst[MAC_ADDR_LEN] = {0x01, 0x80, 0xC2, 0x00, 0x00, 0x02};
+
+/**
+ * @brief Actor or partner information of a LACPDU
+ */
+typedef struct {
+    uint16_t system_priority;
+    mac_addr_t system;
+    uint16_t key;
+    uint16_t port_priority;
+    uint16_t port;
+    uint8_t state;
+} lacp_info_t;
+
+/**
+ * @brief One member slot of a LAG
+ */
+typedef struct {
+    bool used;
+    port_id_t port_id;
+    bool link_up;
+    bool selected;
+    bool distributing;
+    bool ntt;                       /**< A LACPDU is due now */
+    uint8_t actor_state;
+    bool partner_valid;
+    lacp_info_t partner;
+    uint64_t expires_ms;            /**< Partner information valid until */
+    uint64_t next_tx_ms;            /**< Next periodic LACPDU */
+    uint64_t lacpdus_rx;
+    uint64_t lacpdus_tx;
+} lag_member_t;
+
+/**
+ * @brief One LAG
+ */
+typedef struct {
+    bool active;
+    lag_config_t config;
+    uint32_t member_count;
+    lag_member_t members[CONFIG_LAG_MAX_MEMBERS];
+    uint64_t table_updates;
+} lag_t;
+
+/**
+ * @brief Distribution table of a LAG, immutable once published
+ */
+typedef struct {
+    rcu_head_t rcu;
+    uint32_t count;
+    port_id_t ports[CONFIG_LAG_MAX_MEMBERS];
+} lag_dist_t;
+
+/**
+ * @brief LAG state of one switch instance
+ */
+typedef struct {
+    bool initialized;
+    spinlock_t lock;                        /**< Serializes everything but the fast path */
+    uint16_t system_priority;
+    mac_addr_t system;
+    uint16_t member_of[CONFIG_MAX_PORTS];   /**< Member word of each port */
+    lag_dist_t *dist[CONFIG_MAX_LAGS];      /**< Published tables (RCU), NULL when empty */
+    lag_t lags[CONFIG_MAX_LAGS];
+} lag_state_t;
+
+/**
+ * @brief LAG state of each switch instance
+ *
+ * Instance 0 is static; lag_init() allocates the others.
+ */
+static lag_state_t g_lag_state_default;
+static lag_state_t *g_lag_states[CONFIG_MAX_SWITCH_INSTANCES] = { &g_lag_state_default };
+
+static void lag_link_batch(const link_event_batch_t *batch, void *arg);
+
+/**
+ * @brief State of the calling thread's instance, NULL if never initialized
+ */
+static inline lag_state_t *lag_state(void) {
+    return g_lag_states[switch_context_current()];
+}
+
+/**
+ * @brief LAG of a port ID, NULL if none has been created
+ */
+static lag_t *lag_lookup(lag_state_t *st, port_id_t lag_port) {
+    if (!lag_port_is_lag(lag_port) || !st->lags[lag_port - CONFIG_LAG_PORT_BASE].active) {
+        return NULL;
+    }
+    return &st->lags[lag_port - CONFIG_LAG_PORT_BASE];
+}
+
+/**
+ * @brief Member slot of a port in its LAG, NULL if not a member
+ */
+static lag_member_t *lag_find_member(lag_t *lag, port_id_t port_id) {
+    for (uint32_t i = 0; i < CONFIG_LAG_MAX_MEMBERS; i++) {
+        if (lag->members[i].used && lag->members[i].port_id == port_id) {
+            return &lag->members[i];
+        }
+    }
+    return NULL;
+}
+
+static void lag_dist_free(rcu_head_t *head) {
+    free((lag_dist_t *)((char *)head - offsetof(lag_dist_t, rcu)));
+}
+
+/**
+ * @brief Publish the distribution table of a LAG if it changed
+ *
+ * Must be called with the module lock held. If the new table cannot be
+ * allocated the previous one stays published.
+ */
+static void lag_publish(lag_state_t *st, uint32_t index, const port_id_t *ports, uint32_t count) {
+    lag_dist_t *cur = st->dist[index];
+    lag_dist_t *next = NULL;
+
+    if ((cur ? cur->count : 0) == count &&
+        (count == 0 || memcmp(cur->ports, ports, count * sizeof(port_id_t)) == 0)) {
+        return;
+    }
+
+    if (count > 0) {
+        next = (lag_dist_t *)calloc(1, sizeof(lag_dist_t));
+        if (!next) {
+            LOG_ERROR(LOG_CATEGORY_L2, "LAG %u: Failed to publish distribution table", index);
+            return;
+        }
+        next->count = count;
+        memcpy(next->ports, ports, count * sizeof(port_id_t));
+    }
+
+    cur = __atomic_exchange_n(&st->dist[index], next, __ATOMIC_ACQ_REL);
+    if (cur) {
+        rcu_retire(&cur->rcu, lag_dist_free);
+    }
+    st->lags[index].table_updates++;
+    LOG_INFO(LOG_CATEGORY_L2, "LAG %u: %u members distributing", index, count);
+}
+
+/**
+ * @brief Whether two partners are the same aggregator (system and key)
+ */
+static bool lacp_same_aggregator(const lacp_info_t *a, const lacp_info_t *b) {
+    return a->system_priority == b->system_priority && a->key == b->key &&
+           memcmp(a->system.addr, b->system.addr, MAC_ADDR_LEN) == 0;
+}
+
+/**
+ * @brief Rerun selection and mux of every member of a LAG
+ *
+ * Recomputes the actor state of each member, schedules a LACPDU for the
+ * ones whose state changed and publishes the member words and the
+ * distribution table. Must be called with the module lock held.
+ */
+static void lag_update(lag_state_t *st, uint32_t index) {
+    lag_t *lag = &st->lags[index];
+    bool lacp = lag->config.mode != LAG_MODE_STATIC;
+    const lag_member_t *anchor = NULL;
+    port_id_t ports[CONFIG_LAG_MAX_MEMBERS];
+    uint32_t count = 0;
+
+    // The first member facing an aggregatable partner picks the partner of the LAG
+    for (uint32_t i = 0; lacp && i < CONFIG_LAG_MAX_MEMBERS; i++) {
+        const lag_member_t *m = &lag->members[i];
+        if (m->used && m->link_up && m->partner_valid && (m->partner.state & LACP_STATE_AGGREGATION)) {
+            anchor = m;
+            break;
+        }
+    }
+
+    for (uint32_t i = 0; i < CONFIG_LAG_MAX_MEMBERS; i++) {
+        lag_member_t *m = &lag->members[i];
+        uint8_t state = LACP_STATE_AGGREGATION;
+        uint16_t word = (uint16_t)(LAG_MEMBER_VALID | index);
+
+        if (!m->used) {
+            continue;
+        }
+
+        if (lacp) {
+            m->selected = m->link_up && anchor && m->partner_valid &&
+                          (m->partner.state & LACP_STATE_AGGREGATION) &&
+                          lacp_same_aggregator(&m->partner, &anchor->partner);
+            m->distributing = m->selected && (m->partner.state & LACP_STATE_SYNC);
+        } else {
+            m->selected = m->link_up;
+            m->distributing = m->link_up;
+        }
+
+        if (lag->config.mode == LAG_MODE_LACP_ACTIVE) {
+            state |= LACP_STATE_ACTIVITY;
+        }
+        if (lag->config.lacp_fast) {
+            state |= LACP_STATE_TIMEOUT;
+        }
+        if (!m->partner_valid) {
+            state |= LACP_STATE_DEFAULTED;
+        }
+        if (m->selected) {
+            state |= LACP_STATE_SYNC;
+        }
+        if (m->distributing) {
+            state |= LACP_STATE_COLLECTING | LACP_STATE_DISTRIBUTING;
+            word |= LAG_MEMBER_COLLECTING;
+            ports[count++] = m->port_id;
+        }
+        if (lacp && state != m->actor_state) {
+            m->ntt = true;
+        }
+        m->actor_state = state;
+
+        __atomic_store_n(&st->member_of[m->port_id], word, __ATOMIC_RELEASE);
+    }
+
+    lag_publish(st, index, ports, count);
+}
+
+/**
+ * @brief Default system ID of the current instance
+ */
+static void lag_default_system(lag_state_t *st) {
+    uint32_t instance = switch_context_current();
+
+    st->system_priority = LACP_DEFAULT_SYSTEM_PRIORITY;
+    if (instance == SWITCH_INSTANCE_DEFAULT && port_get_mac(0, &st->system) == STATUS_SUCCESS) {
+        return;
+    }
+
+    // Locally administered, unique per instance
+    memset(&st->system, 0, sizeof(st->system));
+    st->system.addr[0] = 0x02;
+    st->system.addr[3] = 0x1A;
+    st->system.addr[4] = (uint8_t)(instance >> 8);
+    st->system.addr[5] = (uint8_t)instance;
+}
+
+/**
+ * @brief Initialize the LAG module of the current switch instance
+ *
+ * @return status_t Status code
+ */
+status_t lag_init(void) {
+    uint32_t instance = switch_context_current();
+    lag_state_t *st;
+
+    if (g_lag_states[instance] == NULL) {
+        g_lag_states[instance] = (lag_state_t *)calloc(1, sizeof(lag_state_t));
+        if (!g_lag_states[instance]) {
+            LOG_ERROR(LOG_CATEGORY_L2, "LAG: Failed to allocate state of switch instance %u", instance);
+            return STATUS_NO_MEMORY;
+        }
+    }
+    st = g_lag_states[instance];
+
+    if (st->initialized) {
+        LOG_WARNING(LOG_CATEGORY_L2, "LAG: Module already initialized");
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    spinlock_init(&st->lock);
+    lag_default_system(st);
+    st->initialized = true;
+
+    // Only the process's own switch has ports that report links
+    if (instance == SWITCH_INSTANCE_DEFAULT && link_event_subscribe(lag_link_batch, NULL) != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_L2, "LAG: Not subscribed to link events");
+    }
+
+    LOG_INFO(LOG_CATEGORY_L2, "LAG: Module initialized");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Delete every LAG and free the module state of the current instance
+ *
+ * @return status_t Status code
+ */
+status_t lag_deinit(void) {
+    uint32_t instance = switch_context_current();
+    lag_state_t *st = g_lag_states[instance];
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (instance == SWITCH_INSTANCE_DEFAULT) {
+        link_event_unsubscribe(lag_link_batch, NULL);
+    }
+
+    spinlock_acquire(&st->lock);
+    for (uint32_t i = 0; i < CONFIG_MAX_LAGS; i++) {
+        lag_dist_t *dist = __atomic_exchange_n(&st->dist[i], NULL, __ATOMIC_ACQ_REL);
+        if (dist) {
+            rcu_retire(&dist->rcu, lag_dist_free);
+        }
+    }
+    memset(st->member_of, 0, sizeof(st->member_of));
+    memset(st->lags, 0, sizeof(st->lags));
+    st->initialized = false;
+    spinlock_release(&st->lock);
+
+    rcu_synchronize();
+    if (instance != SWITCH_INSTANCE_DEFAULT) {
+        g_lag_states[instance] = NULL;
+        free(st);
+    }
+
+    LOG_INFO(LOG_CATEGORY_L2, "LAG: Module cleaned up");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Fill a configuration with defaults
+ *
+ * @param[out] config Configuration to fill
+ */
+void lag_get_default_config(lag_config_t *config) {
+    if (!config) {
+        return;
+    }
+    config->mode = LAG_MODE_LACP_ACTIVE;
+    config->hash = LAG_HASH_L3_L4;
+    config->lacp_fast = false;
+}
+
+static bool lag_config_valid(const lag_config_t *config) {
+    return (unsigned)config->mode <= LAG_MODE_LACP_PASSIVE && (unsigned)config->hash <= LAG_HASH_L3_L4;
+}
+
+/**
+ * @brief Set the LACP system ID
+ *
+ * @param system System MAC
+ * @param priority System priority
+ * @return status_t Status code
+ */
+status_t lag_set_system(const mac_addr_t *system, uint16_t priority) {
+    lag_state_t *st = lag_state();
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!system) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    st->system = *system;
+    st->system_priority = priority;
+    // Partners learn the new ID from the next LACPDU of every member
+    for (uint32_t i = 0; i < CONFIG_MAX_LAGS; i++) {
+        for (uint32_t j = 0; st->lags[i].active && j < CONFIG_LAG_MAX_MEMBERS; j++) {
+            st->lags[i].members[j].ntt = st->lags[i].members[j].used;
+        }
+    }
+    spinlock_release(&st->lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Create a LAG without members
+ *
+ * @param lag_port Port ID of the LAG
+ * @param config Configuration, NULL for the defaults
+ * @return status_t Status code
+ */
+status_t lag_create(port_id_t lag_port, const lag_config_t *config) {
+    lag_state_t *st = lag_state();
+    lag_t *lag;
+
+    if (!st || !st->initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "LAG: Module not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!lag_port_is_lag(lag_port) || (config && !lag_config_valid(config))) {
+        LOG_ERROR(LOG_CATEGORY_L2, "LAG: Invalid LAG port %u or configuration", lag_port);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    lag = &st->lags[lag_port - CONFIG_LAG_PORT_BASE];
+    if (lag->active) {
+        spinlock_release(&st->lock);
+        return STATUS_ALREADY_EXISTS;
+    }
+    memset(lag, 0, sizeof(*lag));
+    if (config) {
+        lag->config = *config;
+    } else {
+        lag_get_default_config(&lag->config);
+    }
+    lag->active = true;
+    spinlock_release(&st->lock);
+
+    LOG_INFO(LOG_CATEGORY_L2, "LAG: Created LAG port %u", lag_port);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Delete a LAG and release its members
+ *
+ * @param lag_port LAG
+ * @return status_t Status code
+ */
+status_t lag_delete(port_id_t lag_port) {
+    lag_state_t *st = lag_state();
+    lag_t *lag;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    spinlock_acquire(&st->lock);
+    lag = lag_lookup(st, lag_port);
+    if (!lag) {
+        spinlock_release(&st->lock);
+        return STATUS_NOT_FOUND;
+    }
+    for (uint32_t i = 0; i < CONFIG_LAG_MAX_MEMBERS; i++) {
+        if (lag->members[i].used) {
+            __atomic_store_n(&st->member_of[lag->members[i].port_id], 0, __ATOMIC_RELEASE);
+        }
+    }
+    lag_publish(st, lag_port - CONFIG_LAG_PORT_BASE, NULL, 0);
+    memset(lag, 0, sizeof(*lag));
+    spinlock_release(&st->lock);
+
+    LOG_INFO(LOG_CATEGORY_L2, "LAG: Deleted LAG port %u", lag_port);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Change the configuration of a LAG
+ *
+ * @param lag_port LAG
+ * @param config New configuration
+ * @return status_t Status code
+ */
+status_t lag_set_config(port_id_t lag_port, const lag_config_t *config) {
+    lag_state_t *st = lag_state();
+    lag_t *lag;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!config || !lag_config_valid(config)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    lag = lag_lookup(st, lag_port);
+    if (!lag) {
+        spinlock_release(&st->lock);
+        return STATUS_NOT_FOUND;
+    }
+    lag->config = *config;
+    lag_update(st, lag_port - CONFIG_LAG_PORT_BASE);
+    spinlock_release(&st->lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Add a physical port to a LAG
+ *
+ * @param lag_port LAG
+ * @param port_id Port
+ * @return status_t Status code
+ */
+status_t lag_add_member(port_id_t lag_port, port_id_t port_id) {
+    lag_state_t *st = lag_state();
+    lag_member_t *slot = NULL;
+    lag_t *lag;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (port_id >= CONFIG_LAG_PORT_BASE) {
+        LOG_ERROR(LOG_CATEGORY_L2, "LAG: Port %u cannot be a member", port_id);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // Link state of the own switch's ports, read before taking the lock
+    bool link_up = switch_context_current() != SWITCH_INSTANCE_DEFAULT || port_is_up(port_id);
+
+    spinlock_acquire(&st->lock);
+    lag = lag_lookup(st, lag_port);
+    if (!lag) {
+        spinlock_release(&st->lock);
+        return STATUS_NOT_FOUND;
+    }
+    if (st->member_of[port_id] & LAG_MEMBER_VALID) {
+        spinlock_release(&st->lock);
+        return STATUS_RESOURCE_BUSY;
+    }
+    for (uint32_t i = 0; i < CONFIG_LAG_MAX_MEMBERS && !slot; i++) {
+        if (!lag->members[i].used) {
+            slot = &lag->members[i];
+        }
+    }
+    if (!slot) {
+        spinlock_release(&st->lock);
+        LOG_ERROR(LOG_CATEGORY_L2, "LAG: LAG port %u has %u members already", lag_port, CONFIG_LAG_MAX_MEMBERS);
+        return STATUS_RESOURCE_EXHAUSTED;
+    }
+
+    memset(slot, 0, sizeof(*slot));
+    slot->used = true;
+    slot->port_id = port_id;
+    slot->link_up = link_up;
+    slot->ntt = true;
+    lag->member_count++;
+    lag_update(st, lag_port - CONFIG_LAG_PORT_BASE);
+    spinlock_release(&st->lock);
+
+    LOG_INFO(LOG_CATEGORY_L2, "LAG: Port %u added to LAG port %u", port_id, lag_port);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Remove a port from its LAG
+ *
+ * @param lag_port LAG
+ * @param port_id Member port
+ * @return status_t Status code
+ */
+status_t lag_remove_member(port_id_t lag_port, port_id_t port_id) {
+    lag_state_t *st = lag_state();
+    lag_member_t *m;
+    lag_t *lag;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    spinlock_acquire(&st->lock);
+    lag = lag_lookup(st, lag_port);
+    m = lag ? lag_find_member(lag, port_id) : NULL;
+    if (!m) {
+        spinlock_release(&st->lock);
+        return STATUS_NOT_FOUND;
+    }
+    memset(m, 0, sizeof(*m));
+    lag->member_count--;
+    lag_update(st, lag_port - CONFIG_LAG_PORT_BASE);
+    __atomic_store_n(&st->member_of[port_id], 0, __ATOMIC_RELEASE);
+    spinlock_release(&st->lock);
+
+    LOG_INFO(LOG_CATEGORY_L2, "LAG: Port %u removed from LAG port %u", port_id, lag_port);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Apply a member link change; module lock held
+ */
+static status_t lag_member_link_locked(lag_state_t *st, port_id_t port_id, bool link_up) {
+    uint16_t word = st->member_of[port_id];
+    uint32_t index = word & LAG_MEMBER_INDEX_MASK;
+    lag_member_t *m;
+
+    if (!(word & LAG_MEMBER_VALID) || (m = lag_find_member(&st->lags[index], port_id)) == NULL) {
+        return STATUS_NOT_FOUND;
+    }
+    if (m->link_up == link_up) {
+        return STATUS_SUCCESS;
+    }
+
+    m->link_up = link_up;
+    if (!link_up) {
+        // The partner seen through a dead link is gone
+        m->partner_valid = false;
+        memset(&m->partner, 0, sizeof(m->partner));
+    } else {
+        m->ntt = true;
+    }
+    lag_update(st, index);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Report the link state of a member
+ *
+ * @param port_id Port
+ * @param link_up New link state
+ * @return status_t Status code
+ */
+status_t lag_set_member_link(port_id_t port_id, bool link_up) {
+    lag_state_t *st = lag_state();
+    status_t status;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (port_id >= CONFIG_MAX_PORTS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    status = lag_member_link_locked(st, port_id, link_up);
+    spinlock_release(&st->lock);
+    return status;
+}
+
+/**
+ * @brief Link event subscriber of the process's own switch
+ */
+static void lag_link_batch(const link_event_batch_t *batch, void *arg) {
+    lag_state_t *st = g_lag_states[SWITCH_INSTANCE_DEFAULT];
+    (void)arg;
+
+    spinlock_acquire(&st->lock);
+    if (st->initialized) {
+        BITMAP_FOR_EACH(bit, batch->changed, LINK_EVENT_PORT_WORDS) {
+            if (bit < CONFIG_MAX_PORTS) {
+                (void)lag_member_link_locked(st, (port_id_t)bit, bitmap_test(batch->up, bit));
+            }
+        }
+    }
+    spinlock_release(&st->lock);
+}
+
+/**
+ * @brief Port a frame received on a physical port belongs to
+ *
+ * @param port_id Receiving port
+ * @return Logical ingress port, PORT_ID_INVALID to drop
+ */
+port_id_t lag_ingress_port(port_id_t port_id) {
+    lag_state_t *st = lag_state();
+    uint16_t word;
+
+    if (!st || port_id >= CONFIG_MAX_PORTS) {
+        return port_id;
+    }
+    word = __atomic_load_n(&st->member_of[port_id], __ATOMIC_ACQUIRE);
+    if (!(word & LAG_MEMBER_VALID)) {
+        return port_id;
+    }
+    return (word & LAG_MEMBER_COLLECTING) ? LAG_PORT_ID(word & LAG_MEMBER_INDEX_MASK) : PORT_ID_INVALID;
+}
+
+/**
+ * @brief Feed bytes into a running FNV-1a hash
+ */
+static inline uint32_t lag_hash_bytes(uint32_t hash, const uint8_t *p, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Hash of the headers a LAG distributes on
+ *
+ * FNV-1a with the finalizer of packet_flow_hash(). The VLAN tag is left
+ * out: an ingress frame, its flooded copies and its retagged unicast all
+ * hash alike, so a flow does not change members when its destination is
+ * learned. MPLS frames hash on their label stack.
+ */
+static uint32_t lag_hash(const packet_buffer_t *packet, lag_hash_t mode) {
+    const packet_metadata_t *md = &packet->metadata;
+    uint32_t hash = 2166136261u;
+
+    if (mode != LAG_HASH_L2 && packet_parsed_has(packet, PACKET_PARSED_L3)) {
+        const uint8_t *l3 = packet_l3_header(packet);
+        if (packet_has_proto(packet, PACKET_PROTO_IPV4)) {
+            hash = lag_hash_bytes(hash, l3 + 12, 8);
+            hash = lag_hash_bytes(hash, l3 + 9, 1);
+        } else {
+            hash = lag_hash_bytes(hash, l3 + 8, 32);
+            hash = lag_hash_bytes(hash, &md->l4_proto, 1);
+        }
+        if (mode == LAG_HASH_L3_L4 && packet_has_proto(packet, PACKET_PROTO_TCP | PACKET_PROTO_UDP) &&
+            !packet_has_proto(packet, PACKET_PROTO_IP_FRAG) && packet->size >= (uint32_t)md->l4_offset + 4) {
+            hash = lag_hash_bytes(hash, packet_l4_header(packet), 4);
+        }
+    } else if (mode != LAG_HASH_L2 && packet_has_proto(packet, PACKET_PROTO_MPLS)) {
+        // All LSPs between two routers share their MACs; the labels tell them apart
+        uint32_t count = md->mpls_count < PACKET_MAX_MPLS_LABELS ? md->mpls_count : PACKET_MAX_MPLS_LABELS;
+        for (uint32_t i = 0; i < count; i++) {
+            uint8_t label[3] = {
+                (uint8_t)(md->mpls_stack[i] >> 24), (uint8_t)(md->mpls_stack[i] >> 16),
+                (uint8_t)((md->mpls_stack[i] >> 8) & 0xF0)
+            };
+            hash = lag_hash_bytes(hash, label, sizeof(label));
+        }
+    } else if (packet->size >= LAG_ETH_HDR_LEN) {
+        uint16_t ethertype = packet_parsed_has(packet, PACKET_PARSED_L2) ?
+                             md->ethertype : (uint16_t)(packet->data[12] << 8 | packet->data[13]);
+        uint8_t extra[2] = { (uint8_t)(ethertype >> 8), (uint8_t)ethertype };
+        hash = lag_hash_bytes(hash, packet->data, LAG_ETH_ADDRS_LEN);
+        hash = lag_hash_bytes(hash, extra, sizeof(extra));
+    }
+
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/**
+ * @brief Physical port that sends a frame out of a port
+ *
+ * @param port_id Egress port or LAG
+ * @param packet Frame
+ * @return Physical egress port, PORT_ID_INVALID to drop
+ */
+port_id_t lag_egress_port(port_id_t port_id, const packet_buffer_t *packet) {
+    lag_state_t *st = lag_state();
+    uint32_t index;
+    port_id_t out = PORT_ID_INVALID;
+
+    if (!lag_port_is_lag(port_id)) {
+        // Members carry the traffic of their LAG only
+        if (st && port_id < CONFIG_MAX_PORTS &&
+            (__atomic_load_n(&st->member_of[port_id], __ATOMIC_RELAXED) & LAG_MEMBER_VALID)) {
+            return PORT_ID_INVALID;
+        }
+        return port_id;
+    }
+    if (!st || !packet || rcu_read_lock() != STATUS_SUCCESS) {
+        return PORT_ID_INVALID;
+    }
+
+    index = port_id - CONFIG_LAG_PORT_BASE;
+    const lag_dist_t *dist = __atomic_load_n(&st->dist[index], __ATOMIC_ACQUIRE);
+    if (dist) {
+        // Multiply-shift maps the hash onto the table without a division
+        uint32_t hash = lag_hash(packet, st->lags[index].config.hash);
+        out = dist->ports[(uint32_t)(((uint64_t)hash * dist->count) >> 32)];
+    }
+
+    rcu_read_unlock();
+    return out;
+}
+
+/**
+ * @brief Whether a frame is a LACPDU
+ */
+bool lag_is_lacpdu(const packet_buffer_t *packet) {
+    return packet && packet->size > LAG_ETH_HDR_LEN &&
+           packet->data[12] == (ETHERTYPE_LACP >> 8) && packet->data[13] == (ETHERTYPE_LACP & 0xFF) &&
+           packet->data[LAG_ETH_HDR_LEN] == LACP_SUBTYPE;
+}
+
+static inline uint16_t lacp_read16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static inline void lacp_write16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+/**
+ * @brief Parse an actor or partner TLV body
+ */
+static void lacp_read_info(const uint8_t *p, lacp_info_t *info) {
+    info->system_priority = lacp_read16(p);
+    memcpy(info->system.addr, p + 2, MAC_ADDR_LEN);
+    info->key = lacp_read16(p + 8);
+    info->port_priority = lacp_read16(p + 10);
+    info->port = lacp_read16(p + 12);
+    info->state = p[14];
+}
+
+/**
+ * @brief Write an actor or partner TLV
+ */
+static void lacp_write_info(uint8_t *p, uint8_t type, const lacp_info_t *info) {
+    p[0] = type;
+    p[1] = LACP_TLV_INFO_LEN;
+    lacp_write16(p + 2, info->system_priority);
+    memcpy(p + 4, info->system.addr, MAC_ADDR_LEN);
+    lacp_write16(p + 10, info->key);
+    lacp_write16(p + 12, info->port_priority);
+    lacp_write16(p + 14, info->port);
+    p[16] = info->state;
+}
+
+/**
+ * @brief Actor information of a member
+ *
+ * The key is the LAG index plus one; port numbers are port IDs plus one,
+ * 0 being reserved.
+ */
+static void lacp_actor_info(const lag_state_t *st, uint32_t index, const lag_member_t *m, lacp_info_t *info) {
+    info->system_priority = st->system_priority;
+    info->system = st->system;
+    info->key = (uint16_t)(index + 1);
+    info->port_priority = LACP_DEFAULT_PORT_PRIORITY;
+    info->port = (uint16_t)(m->port_id + 1);
+    info->state = m->actor_state;
+}
+
+/**
+ * @brief Process a LACPDU received on a member
+ *
+ * @param port_id Receiving port
+ * @param packet LACPDU
+ * @param now_ms Current time in milliseconds
+ * @return status_t Status code
+ */
+status_t lag_receive_lacpdu(port_id_t port_id, const packet_buffer_t *packet, uint64_t now_ms) {
+    lag_state_t *st = lag_state();
+    lacp_info_t actor, seen, ours;
+    const uint8_t *pdu;
+    lag_member_t *m;
+    lag_t *lag;
+    uint32_t index;
+    uint16_t word;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!lag_is_lacpdu(packet) || port_id >= CONFIG_MAX_PORTS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pdu = packet->data + LAG_ETH_HDR_LEN;
+    if (packet->size < LAG_ETH_HDR_LEN + LACP_PDU_MIN_LEN ||
+        pdu[2] != LACP_TLV_ACTOR || pdu[3] != LACP_TLV_INFO_LEN ||
+        pdu[22] != LACP_TLV_PARTNER || pdu[23] != LACP_TLV_INFO_LEN) {
+        LOG_DEBUG(LOG_CATEGORY_L2, "LAG: Malformed LACPDU on port %u", port_id);
+        return STATUS_INVALID_PACKET;
+    }
+    lacp_read_info(pdu + 4, &actor);
+    lacp_read_info(pdu + 24, &seen);
+
+    spinlock_acquire(&st->lock);
+    word = st->member_of[port_id];
+    index = word & LAG_MEMBER_INDEX_MASK;
+    lag = &st->lags[index];
+    if (!(word & LAG_MEMBER_VALID) || lag->config.mode == LAG_MODE_STATIC ||
+        (m = lag_find_member(lag, port_id)) == NULL) {
+        spinlock_release(&st->lock);
+        return STATUS_NOT_FOUND;
+    }
+
+    m->lacpdus_rx++;
+    if (!m->link_up) {
+        spinlock_release(&st->lock);
+        return STATUS_SUCCESS;
+    }
+
+    // A partner that does not know us as we are gets a LACPDU now
+    lacp_actor_info(st, index, m, &ours);
+    if (!m->partner_valid || memcmp(&seen.system, &ours.system, sizeof(ours.system)) != 0 ||
+        seen.system_priority != ours.system_priority || seen.key != ours.key || seen.port != ours.port ||
+        seen.port_priority != ours.port_priority || seen.state != ours.state) {
+        m->ntt = true;
+    }
+
+    m->partner = actor;
+    m->partner_valid = true;
+    m->expires_ms = now_ms + (lag->config.lacp_fast ? LACP_SHORT_TIMEOUT_MS : LACP_LONG_TIMEOUT_MS);
+    lag_update(st, index);
+    spinlock_release(&st->lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Build the LACPDU of a member
+ */
+static packet_buffer_t *lacp_build(const lag_state_t *st, uint32_t index, const lag_member_t *m) {
+    packet_buffer_t *packet = packet_buffer_alloc(LACP_FRAME_LEN);
+    lacp_info_t actor;
+    uint8_t *p;
+
+    if (!packet) {
+        return NULL;
+    }
+    packet->size = LACP_FRAME_LEN;
+    memset(packet->data, 0, LACP_FRAME_LEN);
+
+    memcpy(packet->data, g_lacp_dst, MAC_ADDR_LEN);
+    memcpy(packet->data + MAC_ADDR_LEN, st->system.addr, MAC_ADDR_LEN);
+    lacp_write16(packet->data + 12, ETHERTYPE_LACP);
+
+    p = packet->data + LAG_ETH_HDR_LEN;
+    p[0] = LACP_SUBTYPE;
+    p[1] = LACP_VERSION;
+    lacp_actor_info(st, index, m, &actor);
+    lacp_write_info(p + 2, LACP_TLV_ACTOR, &actor);
+    lacp_write_info(p + 22, LACP_TLV_PARTNER, &m->partner);
+    p[42] = LACP_TLV_COLLECTOR;
+    p[43] = LACP_TLV_COLLECTOR_LEN;
+    // Collector max delay, reserved octets and the terminator TLV stay zero
+
+    packet->metadata.port = m->port_id;
+    packet->metadata.direction = PACKET_DIR_TX;
+    return packet;
+}
+
+/**
+ * @brief Expire stale partners and send the LACPDUs that are due
+ *
+ * @param now_ms Current time in milliseconds
+ * @param transmit Sends a LACPDU
+ * @param arg Argument of transmit
+ * @return Number of LACPDUs sent
+ */
+uint32_t lag_process_timers(uint64_t now_ms, lag_transmit_fn transmit, void *arg) {
+    lag_state_t *st = lag_state();
+    struct {
+        port_id_t port_id;
+        packet_buffer_t *packet;
+    } out[CONFIG_MAX_LAGS * CONFIG_LAG_MAX_MEMBERS];
+    uint32_t count = 0;
+
+    if (!st || !st->initialized) {
+        return 0;
+    }
+
+    spinlock_acquire(&st->lock);
+    for (uint32_t i = 0; i < CONFIG_MAX_LAGS; i++) {
+        lag_t *lag = &st->lags[i];
+        bool expired = false;
+
+        if (!lag->active || lag->config.mode == LAG_MODE_STATIC) {
+            continue;
+        }
+
+        for (uint32_t j = 0; j < CONFIG_LAG_MAX_MEMBERS; j++) {
+            lag_member_t *m = &lag->members[j];
+            if (m->used && m->partner_valid && now_ms >= m->expires_ms) {
+                LOG_INFO(LOG_CATEGORY_L2, "LAG: Partner of port %u timed out", m->port_id);
+                m->partner_valid = false;
+                memset(&m->partner, 0, sizeof(m->partner));
+                expired = true;
+            }
+        }
+        if (expired) {
+            lag_update(st, i);
+        }
+
+        for (uint32_t j = 0; j < CONFIG_LAG_MAX_MEMBERS; j++) {
+            lag_member_t *m = &lag->members[j];
+            bool partner_active = m->partner_valid && (m->partner.state & LACP_STATE_ACTIVITY);
+            packet_buffer_t *packet;
+
+            if (!m->used || !m->link_up ||
+                (lag->config.mode != LAG_MODE_LACP_ACTIVE && !partner_active) ||
+                (!m->ntt && now_ms < m->next_tx_ms)) {
+                continue;
+            }
+
+            packet = lacp_build(st, i, m);
+            if (!packet) {
+                LOG_WARNING_RATELIMITED(LOG_CATEGORY_L2, "LAG: No buffer for LACPDU on port %u", m->port_id);
+                continue;
+            }
+            out[count].port_id = m->port_id;
+            out[count].packet = packet;
+            count++;
+
+            // The partner's timeout sets our rate
+            m->ntt = false;
+            m->lacpdus_tx++;
+            m->next_tx_ms = now_ms + ((m->partner_valid && (m->partner.state & LACP_STATE_TIMEOUT)) ?
+                                      LACP_FAST_PERIODIC_MS : LACP_SLOW_PERIODIC_MS);
+        }
+    }
+    spinlock_release(&st->lock);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (transmit) {
+            transmit(out[i].port_id, out[i].packet, arg);
+        } else {
+            packet_buffer_free(out[i].packet);
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Get the state of a LAG and its members
+ *
+ * @param lag_port LAG
+ * @param[out] info State
+ * @return status_t Status code
+ */
+status_t lag_get_info(port_id_t lag_port, lag_info_t *info) {
+    lag_state_t *st = lag_state();
+    const lag_t *lag;
+    uint32_t n = 0;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!info) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    lag = lag_lookup(st, lag_port);
+    if (!lag) {
+        spinlock_release(&st->lock);
+        return STATUS_NOT_FOUND;
+    }
+
+    memset(info, 0, sizeof(*info));
+    info->lag_port = lag_port;
+    info->config = lag->config;
+    info->key = (uint16_t)(lag_port - CONFIG_LAG_PORT_BASE + 1);
+    info->table_updates = lag->table_updates;
+    for (uint32_t i = 0; i < CONFIG_LAG_MAX_MEMBERS; i++) {
+        const lag_member_t *m = &lag->members[i];
+        lag_member_info_t *mi = &info->members[n];
+
+        if (!m->used) {
+            continue;
+        }
+        mi->port_id = m->port_id;
+        mi->link_up = m->link_up;
+        mi->selected = m->selected;
+        mi->distributing = m->distributing;
+        mi->actor_state = m->actor_state;
+        if (m->partner_valid) {
+            mi->partner_state = m->partner.state;
+            mi->partner_system_priority = m->partner.system_priority;
+            mi->partner_system = m->partner.system;
+            mi->partner_key = m->partner.key;
+            mi->partner_port = m->partner.port;
+        }
+        mi->lacpdus_rx = m->lacpdus_rx;
+        mi->lacpdus_tx = m->lacpdus_tx;
+        info->active_count += m->distributing;
+        n++;
+    }
+    info->member_count = n;
+    spinlock_release(&st->lock);
+    return STATUS_SUCCESS;
+}
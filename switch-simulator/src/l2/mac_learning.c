@@ -4,17 +4,27 @@
  *
  * This file implements the MAC address learning mechanism for the switch simulator,
  * handling packet processing for MAC learning, MAC table updates, and related operations.
+ *
+ * In queued mode every forwarding thread owns a single-producer learn queue,
+ * created on its first new source MAC. The learner thread drains the queues
+ * in batches and does the rate limiting, table writes and statistics, so
+ * the forwarding path only does a lock-free MAC table lookup.
  */
 
+#define _GNU_SOURCE
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "common/types.h"
+#include "common/config.h"
 #include "common/error_codes.h"
 #include "common/logging.h"
 #include "common/threading.h"
 #include "hal/port.h"
 #include "hal/packet.h"
+#include "hal/link_event.h"
 #include "l2/mac_table.h"
 #include "l2/mac_learning.h"
 #include "l2/vlan.h"
@@ -30,6 +40,66 @@
  */
 #define MAC_LEARNING_DEFAULT_ENABLED true
 
+/**
+ * @brief Learn queue geometry
+ */
+#define MAC_LEARN_QUEUE_SIZE    CONFIG_MAC_LEARN_QUEUE_SIZE
+#define MAC_LEARN_BATCH         CONFIG_MAC_LEARN_BATCH
+#define MAC_LEARN_MAX_QUEUES    (CONFIG_MAX_WORKER_THREADS + 4)
+
+/**
+ * @brief Recently queued events remembered per queue to drop duplicates
+ */
+#define MAC_LEARN_FILTER_BITS   10
+#define MAC_LEARN_FILTER_SIZE   (1u << MAC_LEARN_FILTER_BITS)
+
+/**
+ * @brief Learner sleep when all queues are empty (microseconds)
+ */
+#define MAC_LEARN_IDLE_SLEEP_US 100
+
+/**
+ * @brief Cache line size used to separate queue indices
+ */
+#define MAC_LEARN_CACHE_LINE    64
+
+/**
+ * @brief Source MAC seen on a port that the MAC table does not map to it
+ */
+typedef struct {
+    mac_addr_t mac;                  // Source MAC
+    vlan_id_t vlan_id;               // VLAN the frame was received on
+    port_id_t port_id;               // Ingress port
+    uint32_t time;                   // Receive time in seconds
+} mac_learn_event_t;
+
+/**
+ * @brief Duplicate filter slot
+ */
+typedef struct {
+    mac_addr_t mac;
+    vlan_id_t vlan_id;
+    port_id_t port_id;
+} mac_learn_filter_t;
+
+/**
+ * @brief Single-producer/single-consumer learn queue
+ */
+typedef struct {
+    /* Producer side */
+    volatile uint32_t head __attribute__((aligned(MAC_LEARN_CACHE_LINE)));
+    uint32_t filter_time;            // Second the duplicate filter belongs to
+    uint32_t queued;                 // Events queued
+    uint32_t drops;                  // Events refused because the queue was full
+    uint32_t dedup_hits;             // Events dropped by the duplicate filter
+    mac_learn_filter_t filter[MAC_LEARN_FILTER_SIZE]; // Events queued during filter_time
+
+    /* Consumer side */
+    volatile uint32_t tail __attribute__((aligned(MAC_LEARN_CACHE_LINE)));
+
+    mac_learn_event_t events[MAC_LEARN_QUEUE_SIZE] __attribute__((aligned(MAC_LEARN_CACHE_LINE)));
+} mac_learn_queue_t;
+
 /**
  * @brief MAC learning statistics structure
  */
@@ -61,6 +131,14 @@ typedef struct {
     uint32_t current_time;           // Current simulation time in seconds
     uint32_t num_ports;              // Number of ports in the system
     spinlock_t lock;                 // Lock for thread-safe access
+    mac_learn_queue_t *queues[MAC_LEARN_MAX_QUEUES]; // Learn queues, one per producer thread
+    uint32_t queue_count;            // Queues published to the learner
+    uint32_t generation;             // Bumped on cleanup to orphan thread queue pointers
+    spinlock_t drain_lock;           // Keeps a single consumer on the queues
+    volatile bool queued_mode;       // Learn through the queues
+    volatile bool learner_stop;      // Asks the learner thread to exit
+    bool learner_running;            // Learner thread was started
+    pthread_t learner;               // Learner thread
 } mac_learning_state_t;
 
 /**
@@ -68,6 +146,12 @@ typedef struct {
  */
 static mac_learning_state_t g_mac_learning;
 
+/**
+ * @brief Learn queue of the calling thread and the generation it belongs to
+ */
+static __thread mac_learn_queue_t *t_learn_queue;
+static __thread uint32_t t_learn_generation;
+
 /**
  * @brief Acquire lock for MAC learning operations
  */
@@ -166,6 +250,275 @@ static void update_port_learning_rate(port_id_t port_id, uint32_t current_time)
     }
 }
 
+/**
+ * @brief Get the calling thread's learn queue, creating it on first use
+ *
+ * @return mac_learn_queue_t* Queue, or NULL if no queue could be created
+ */
+static mac_learn_queue_t *mac_learn_get_queue(void) {
+    uint32_t generation = __atomic_load_n(&g_mac_learning.generation, __ATOMIC_ACQUIRE);
+
+    if (t_learn_queue != NULL && t_learn_generation == generation) {
+        return t_learn_queue;
+    }
+
+    mac_learn_queue_t *queue = NULL;
+    if (posix_memalign((void **)&queue, MAC_LEARN_CACHE_LINE, sizeof(mac_learn_queue_t)) != 0) {
+        return NULL;
+    }
+    memset(queue, 0, sizeof(*queue));
+
+    mac_learning_acquire_lock();
+    if (g_mac_learning.queue_count >= MAC_LEARN_MAX_QUEUES) {
+        mac_learning_release_lock();
+        free(queue);
+        LOG_WARNING(LOG_CATEGORY_L2, "No learn queue left for this thread");
+        return NULL;
+    }
+    g_mac_learning.queues[g_mac_learning.queue_count] = queue;
+    // Publish the queue after it is set up
+    __atomic_store_n(&g_mac_learning.queue_count, g_mac_learning.queue_count + 1, __ATOMIC_RELEASE);
+    mac_learning_release_lock();
+
+    t_learn_queue = queue;
+    t_learn_generation = generation;
+    return queue;
+}
+
+/**
+ * @brief Queue a learn event (producer side)
+ *
+ * Events repeated within the same second are dropped, so a flood from one
+ * unknown source costs one queue slot until the learner has applied it.
+ *
+ * @param mac Source MAC
+ * @param vlan_id VLAN ID
+ * @param port_id Ingress port
+ * @param current_time Current time in seconds
+ * @return status_t STATUS_SUCCESS if queued or a duplicate, error code otherwise
+ */
+static status_t mac_learn_enqueue(const mac_addr_t *mac, vlan_id_t vlan_id, port_id_t port_id,
+                                  uint32_t current_time) {
+    mac_learn_queue_t *queue = mac_learn_get_queue();
+    if (queue == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    if (queue->filter_time != current_time) {
+        memset(queue->filter, 0, sizeof(queue->filter));
+        queue->filter_time = current_time;
+    }
+
+    uint32_t h = ((uint32_t)mac->addr[2] << 24 | (uint32_t)mac->addr[3] << 16 |
+                  (uint32_t)mac->addr[4] << 8 | mac->addr[5]) ^ ((uint32_t)vlan_id << 20) ^ port_id;
+    mac_learn_filter_t *seen = &queue->filter[(h * 0x9E3779B1u) >> (32 - MAC_LEARN_FILTER_BITS)];
+    if (seen->port_id == port_id && seen->vlan_id == vlan_id &&
+        memcmp(seen->mac.addr, mac->addr, MAC_ADDR_LEN) == 0) {
+        queue->dedup_hits++;
+        return STATUS_SUCCESS;
+    }
+
+    uint32_t head = queue->head;
+    if (head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) >= MAC_LEARN_QUEUE_SIZE) {
+        queue->drops++;
+        return STATUS_RESOURCE_EXHAUSTED;
+    }
+
+    mac_learn_event_t *event = &queue->events[head & (MAC_LEARN_QUEUE_SIZE - 1)];
+    event->mac = *mac;
+    event->vlan_id = vlan_id;
+    event->port_id = port_id;
+    event->time = current_time;
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+
+    seen->mac = *mac;
+    seen->vlan_id = vlan_id;
+    seen->port_id = port_id;
+    queue->queued++;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Apply a batch of learn events
+ *
+ * The table is probed without locks, the learning lock is taken once for
+ * the rate limit checks of the whole batch and once for its statistics,
+ * and the table writes happen between the two.
+ *
+ * @param events Events taken from one queue
+ * @param n Number of events
+ */
+static void mac_learn_apply_batch(const mac_learn_event_t *events, uint32_t n) {
+    uint16_t pending[MAC_LEARN_BATCH];
+    bool moved[MAC_LEARN_BATCH];
+    uint32_t count = 0;
+
+    // Drop events the table already reflects
+    for (uint32_t i = 0; i < n; i++) {
+        port_id_t existing_port;
+        status_t status = mac_table_lookup(events[i].mac, events[i].vlan_id, &existing_port);
+        if (status == STATUS_SUCCESS && existing_port == events[i].port_id) {
+            continue;
+        }
+        if (status != STATUS_SUCCESS && status != STATUS_NOT_FOUND) {
+            continue;
+        }
+        moved[count] = (status == STATUS_SUCCESS);
+        pending[count++] = (uint16_t)i;
+    }
+
+    if (count == 0) {
+        return;
+    }
+
+    // Rate limit the batch; new MACs count against their port up front
+    mac_learning_acquire_lock();
+    uint32_t allowed = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const mac_learn_event_t *event = &events[pending[i]];
+        if (!is_learning_enabled_for_port(event->port_id) ||
+            is_port_rate_limited(event->port_id, event->time)) {
+            continue;
+        }
+        if (!moved[i]) {
+            update_port_learning_rate(event->port_id, event->time);
+        }
+        moved[allowed] = moved[i];
+        pending[allowed++] = pending[i];
+    }
+    mac_learning_release_lock();
+
+    uint32_t learned = 0;
+    uint32_t relearned = 0;
+    for (uint32_t i = 0; i < allowed; i++) {
+        const mac_learn_event_t *event = &events[pending[i]];
+        status_t status = mac_table_add(event->mac, event->port_id, event->vlan_id, false);
+        if (status == STATUS_SUCCESS) {
+            if (moved[i]) {
+                relearned++;
+            } else {
+                learned++;
+            }
+        } else if (status == STATUS_RESOURCE_BUSY) {
+            // Flapping MAC held on its port by the table's move dampening
+        } else if (status == STATUS_TABLE_FULL) {
+            LOG_WARNING_RATELIMITED(LOG_CATEGORY_L2, "Failed to learn MAC: MAC table is full");
+        } else {
+            LOG_ERROR_RATELIMITED(LOG_CATEGORY_L2, "Failed to learn MAC: error %d", status);
+        }
+    }
+
+    mac_learning_acquire_lock();
+    g_mac_learning.stats.total_learned += learned;
+    g_mac_learning.stats.total_moved += relearned;
+    mac_learning_release_lock();
+}
+
+/**
+ * @brief Apply queued learn events now
+ *
+ * @return uint32_t Number of events taken from the queues
+ */
+uint32_t mac_learning_drain_queues(void) {
+    mac_learn_event_t batch[MAC_LEARN_BATCH];
+    uint32_t total = 0;
+
+    if (spinlock_try_acquire(&g_mac_learning.drain_lock)) {
+        return 0;
+    }
+
+    uint32_t queues = __atomic_load_n(&g_mac_learning.queue_count, __ATOMIC_ACQUIRE);
+    for (uint32_t q = 0; q < queues; q++) {
+        mac_learn_queue_t *queue = g_mac_learning.queues[q];
+        uint32_t tail = queue->tail;
+        uint32_t avail = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) - tail;
+        uint32_t n = avail < MAC_LEARN_BATCH ? avail : MAC_LEARN_BATCH;
+
+        for (uint32_t i = 0; i < n; i++) {
+            batch[i] = queue->events[(tail + i) & (MAC_LEARN_QUEUE_SIZE - 1)];
+        }
+        // Give the slots back before the slow part
+        __atomic_store_n(&queue->tail, tail + n, __ATOMIC_RELEASE);
+
+        if (n > 0) {
+            mac_learn_apply_batch(batch, n);
+            total += n;
+        }
+    }
+
+    spinlock_release(&g_mac_learning.drain_lock);
+    return total;
+}
+
+/**
+ * @brief Learner thread: drain the queues until asked to stop
+ */
+static void *mac_learner_thread(void *arg) {
+    (void)arg;
+
+    while (!g_mac_learning.learner_stop) {
+        if (mac_learning_drain_queues() == 0) {
+            usleep(MAC_LEARN_IDLE_SLEEP_US);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Start the learner thread and switch learning to queued mode
+ *
+ * @return status_t Status code
+ */
+status_t mac_learning_start_learner(void) {
+    if (!g_mac_learning.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "MAC learning not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (g_mac_learning.learner_running) {
+        return STATUS_ALREADY_EXISTS;
+    }
+
+    g_mac_learning.learner_stop = false;
+    if (pthread_create(&g_mac_learning.learner, NULL, mac_learner_thread, NULL) != 0) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Failed to start MAC learner thread");
+        return STATUS_FAILURE;
+    }
+    pthread_setname_np(g_mac_learning.learner, "mac-learner");
+
+    g_mac_learning.learner_running = true;
+    g_mac_learning.queued_mode = true;
+
+    LOG_INFO(LOG_CATEGORY_L2, "MAC learner thread started");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Stop the learner thread and return to inline learning
+ *
+ * @return status_t Status code
+ */
+status_t mac_learning_stop_learner(void) {
+    if (!g_mac_learning.learner_running) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    g_mac_learning.queued_mode = false;
+    g_mac_learning.learner_stop = true;
+    pthread_join(g_mac_learning.learner, NULL);
+    g_mac_learning.learner_running = false;
+
+    // Apply what producers queued before they saw inline mode
+    while (mac_learning_drain_queues() > 0) {
+    }
+
+    LOG_INFO(LOG_CATEGORY_L2, "MAC learner thread stopped");
+    return STATUS_SUCCESS;
+}
+
+static void mac_learning_link_batch(const link_event_batch_t *batch, void *arg);
+
 /**
  * @brief Initialize MAC learning functionality
  *
@@ -185,6 +538,9 @@ status_t mac_learning_init(uint32_t num_ports) {
         return STATUS_INVALID_PARAMETER;
     }
     
+    spinlock_set_class(&g_mac_learning.lock, "mac_learning");
+    spinlock_set_class(&g_mac_learning.drain_lock, "mac_learning.drain");
+
     // Allocate per-port arrays
     g_mac_learning.port_learning_enabled = (bool*)calloc(num_ports, sizeof(bool));
     g_mac_learning.port_rates = (port_learning_rate_t*)calloc(num_ports, sizeof(port_learning_rate_t));
@@ -211,6 +567,11 @@ status_t mac_learning_init(uint32_t num_ports) {
     
     g_mac_learning.initialized = true;
     
+    // Ports that go down are flushed a link event batch at a time
+    if (link_event_subscribe(mac_learning_link_batch, NULL) != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_L2, "MAC learning not subscribed to link events");
+    }
+    
     LOG_INFO(LOG_CATEGORY_L2, "MAC learning initialized for %u ports", num_ports);
     return STATUS_SUCCESS;
 }
@@ -223,8 +584,19 @@ status_t mac_learning_init(uint32_t num_ports) {
 status_t mac_learning_cleanup(void) {
     LOG_INFO(LOG_CATEGORY_L2, "Cleaning up MAC learning");
     
+    link_event_unsubscribe(mac_learning_link_batch, NULL);
+    mac_learning_stop_learner();
+    
     mac_learning_acquire_lock();
     
+    // Free the learn queues; threads notice the new generation
+    for (uint32_t q = 0; q < g_mac_learning.queue_count; q++) {
+        free(g_mac_learning.queues[q]);
+        g_mac_learning.queues[q] = NULL;
+    }
+    g_mac_learning.queue_count = 0;
+    __atomic_add_fetch(&g_mac_learning.generation, 1, __ATOMIC_RELEASE);
+    
     // Free allocated resources
     if (g_mac_learning.port_learning_enabled != NULL) {
         free(g_mac_learning.port_learning_enabled);
@@ -445,41 +817,44 @@ status_t mac_learning_process_packet(const packet_buffer_t *packet, port_id_t po
         return STATUS_INVALID_PARAMETER;
     }
     
-    mac_learning_acquire_lock();
-    
     // Update current time
-    g_mac_learning.current_time = current_time;
+    __atomic_store_n(&g_mac_learning.current_time, current_time, __ATOMIC_RELAXED);
     
     // Check if learning is enabled for this port
     if (!is_learning_enabled_for_port(port_id)) {
-        mac_learning_release_lock();
         return STATUS_SUCCESS; // Learning disabled, but not an error
     }
     
-    // Extract Ethernet header from packet
-    // функция packet_get_ethernet_header ожидает 
-    // двойной указатель (ethernet_header_t **) в качестве второго аргумента, 
-    // но в вызове одинарный указатель (&eth_header).
-    ethernet_header_t *eth_header = NULL; // Инициализируем указатель
-    status_t status = packet_get_ethernet_header(packet, &eth_header);
-    if (status != STATUS_SUCCESS) {
-        mac_learning_release_lock();
-        LOG_ERROR(LOG_CATEGORY_L2, "Failed to extract Ethernet header from packet");
-        return status;
-    }
-    
-    // Get VLAN ID from packet
+    const mac_addr_t *src_mac;
     vlan_id_t vlan_id = VLAN_ID_DEFAULT;
-    status = packet_get_vlan_id(packet, &vlan_id);
-    if (status != STATUS_SUCCESS && status != STATUS_NOT_FOUND) {
-        mac_learning_release_lock();
-        LOG_ERROR(LOG_CATEGORY_L2, "Failed to get VLAN ID from packet");
-        return status;
+    status_t status;
+
+    if (packet_parsed_has(packet, PACKET_PARSED_L2)) {
+        // Ingress already parsed the frame: use the cached headers
+        src_mac = &packet->metadata.src_mac;
+        if (packet->metadata.vlan_count > 0) {
+            vlan_id = packet->metadata.vlan_tci[0] & 0x0FFF;
+        }
+    } else {
+        // Extract Ethernet header from packet
+        ethernet_header_t *eth_header = NULL;
+        status = packet_get_ethernet_header(packet, &eth_header);
+        if (status != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_L2, "Failed to extract Ethernet header from packet");
+            return status;
+        }
+        src_mac = &eth_header->src_mac;
+
+        // Get VLAN ID from packet
+        status = packet_get_vlan_id(packet, &vlan_id);
+        if (status != STATUS_SUCCESS && status != STATUS_NOT_FOUND) {
+            LOG_ERROR(LOG_CATEGORY_L2, "Failed to get VLAN ID from packet");
+            return status;
+        }
     }
     
     // Don't learn from multicast/broadcast source MACs
-    if ((*eth_header).src_mac.addr[0] & 0x01) {
-        mac_learning_release_lock();
+    if ((*src_mac).addr[0] & 0x01) {
         LOG_DEBUG(LOG_CATEGORY_L2, "Skipping learning for multicast/broadcast source MAC");
         return STATUS_SUCCESS;
     }
@@ -488,71 +863,74 @@ status_t mac_learning_process_packet(const packet_buffer_t *packet, port_id_t po
     stp_port_state_t stp_state;
     status = stp_get_port_state(port_id, vlan_id, &stp_state);
     if (status == STATUS_SUCCESS && stp_state != STP_PORT_STATE_FORWARDING) {
-        mac_learning_release_lock();
         LOG_DEBUG(LOG_CATEGORY_L2, "Skipping learning on port %u in non-forwarding STP state", port_id);
         return STATUS_SUCCESS;
     }
     
+    // Check if MAC already exists in table for this VLAN. The lookup is
+    // lock-free and refreshes the entry, so a known source on the same
+    // port (the common case) never takes a lock.
+    port_id_t existing_port;
+    status = mac_table_lookup((*src_mac), vlan_id, &existing_port);
+    if (status == STATUS_SUCCESS && existing_port == port_id) {
+        return STATUS_SUCCESS;
+    }
+    if (status != STATUS_SUCCESS && status != STATUS_NOT_FOUND) {
+        // Some other error during lookup
+        LOG_ERROR(LOG_CATEGORY_L2, "MAC table lookup failed with error %d", status);
+        return status;
+    }
+    bool moved = (status == STATUS_SUCCESS);
+    
+    // Leave the write to the learner thread
+    if (g_mac_learning.queued_mode) {
+        return mac_learn_enqueue(src_mac, vlan_id, port_id, current_time);
+    }
+    
     // Check rate limiting
-    if (is_port_rate_limited(port_id, current_time)) {
-        mac_learning_release_lock();
+    mac_learning_acquire_lock();
+    bool rate_limited = is_port_rate_limited(port_id, current_time);
+    mac_learning_release_lock();
+    if (rate_limited) {
         return STATUS_SUCCESS; // Rate limited, but not an error
     }
     
-    // Check if MAC already exists in table for this VLAN
-    port_id_t existing_port;
-    status = mac_table_lookup((*eth_header).src_mac, vlan_id, &existing_port);
-    //mac_table_entry_t entry;    
-    //status = mac_table_lookup((*eth_header).src_mac, vlan_id, &entry);
-   // status = mac_table_lookup((*eth_header).src_mac, vlan_id, &port_id);
-   // // Затем, если вам нужен port_id из записи:
-   // port_id_t existing_port = entry.port_id; // предполагая, что в структуре есть такое поле
-    
-
+    // The add is an upsert, so a racing learner of the same MAC is harmless
+    status = mac_table_add((*src_mac), port_id, vlan_id, false);
     if (status == STATUS_SUCCESS) {
-        // MAC already exists
-        if (existing_port != port_id) {
-            // MAC has moved to a different port
-            LOG_INFO(LOG_CATEGORY_L2, "MAC %02x:%02x:%02x:%02x:%02x:%02x moved from port %u to port %u on VLAN %u",
-                    (*eth_header).src_mac.addr[0], (*eth_header).src_mac.addr[1], (*eth_header).src_mac.addr[2],
-                    (*eth_header).src_mac.addr[3], (*eth_header).src_mac.addr[4], (*eth_header).src_mac.addr[5],
+        if (moved) {
+            // MAC has moved to a different port; flaps are dampened and
+            // reported by the table, so a move is not worth more than debug
+            LOG_DEBUG(LOG_CATEGORY_L2, "MAC %02x:%02x:%02x:%02x:%02x:%02x moved from port %u to port %u on VLAN %u",
+                    (*src_mac).addr[0], (*src_mac).addr[1], (*src_mac).addr[2],
+                    (*src_mac).addr[3], (*src_mac).addr[4], (*src_mac).addr[5],
                     existing_port, port_id, vlan_id);
-            
-            // Update MAC table with new port
-            // status = mac_table_add(eth_header.src_mac, port_id, vlan_id, false);
-            status = mac_table_add((*eth_header).src_mac, port_id, vlan_id, false);
-            if (status == STATUS_SUCCESS) {
-                g_mac_learning.stats.total_moved++;
-            }
+        } else {
+            LOG_DEBUG(LOG_CATEGORY_L2, "Learned new MAC %02x:%02x:%02x:%02x:%02x:%02x on port %u VLAN %u",
+                    (*src_mac).addr[0], (*src_mac).addr[1], (*src_mac).addr[2],
+                    (*src_mac).addr[3], (*src_mac).addr[4], (*src_mac).addr[5],
+                    port_id, vlan_id);
         }
-        // If on same port, MAC table entry was already updated by mac_table_lookup
-    }
-    else if (status == STATUS_NOT_FOUND)
-    {
-      // New MAC address - learn it
-      status = mac_table_add((*eth_header).src_mac, port_id, vlan_id, false);
-      if (status == STATUS_SUCCESS) {
-          LOG_DEBUG(LOG_CATEGORY_L2, "Learned new MAC %02x:%02x:%02x:%02x:%02x:%02x on port %u VLAN %u",
-                  (*eth_header).src_mac.addr[0], (*eth_header).src_mac.addr[1], (*eth_header).src_mac.addr[2],
-                  (*eth_header).src_mac.addr[3], (*eth_header).src_mac.addr[4], (*eth_header).src_mac.addr[5],
-                  port_id, vlan_id);
-
-          // Update statistics
-          g_mac_learning.stats.total_learned++;
-          update_port_learning_rate(port_id, current_time);
-      } else if (status == STATUS_TABLE_FULL) {
-          LOG_WARNING(LOG_CATEGORY_L2, "Failed to learn MAC: MAC table is full");
-      } else {
-          LOG_ERROR(LOG_CATEGORY_L2, "Failed to learn MAC: error %d", status);
-      }
-    }
-    else {
-      // Some other error during lookup
-      LOG_ERROR(LOG_CATEGORY_L2, "MAC table lookup failed with error %d", status);
-  }
-
-  mac_learning_release_lock();
-  return status;
+
+        // Update statistics
+        mac_learning_acquire_lock();
+        if (moved) {
+            g_mac_learning.stats.total_moved++;
+        } else {
+            g_mac_learning.stats.total_learned++;
+            update_port_learning_rate(port_id, current_time);
+        }
+        mac_learning_release_lock();
+    } else if (status == STATUS_RESOURCE_BUSY) {
+        // Flapping MAC held on its port by the table's move dampening
+        status = STATUS_SUCCESS;
+    } else if (status == STATUS_TABLE_FULL) {
+        LOG_WARNING_RATELIMITED(LOG_CATEGORY_L2, "Failed to learn MAC: MAC table is full");
+    } else {
+        LOG_ERROR_RATELIMITED(LOG_CATEGORY_L2, "Failed to learn MAC: error %d", status);
+    }
+
+    return status;
 }
 // new:v1>
 
@@ -728,6 +1106,17 @@ status_t mac_learning_get_stats(mac_learning_stats_t *stats) {
     stats->rate_limited = g_mac_learning.stats.rate_limited;
     stats->learning_enabled = g_mac_learning.learning_enabled;
 
+    // Queue counters are written by their producers; sum a snapshot
+    stats->queued_events = 0;
+    stats->queue_drops = 0;
+    stats->dedup_hits = 0;
+    for (uint32_t q = 0; q < g_mac_learning.queue_count; q++) {
+        const mac_learn_queue_t *queue = g_mac_learning.queues[q];
+        stats->queued_events += __atomic_load_n(&queue->queued, __ATOMIC_RELAXED);
+        stats->queue_drops += __atomic_load_n(&queue->drops, __ATOMIC_RELAXED);
+        stats->dedup_hits += __atomic_load_n(&queue->dedup_hits, __ATOMIC_RELAXED);
+    }
+
     mac_learning_release_lock();
 
     return STATUS_SUCCESS;
@@ -870,6 +1259,40 @@ status_t mac_learning_handle_port_state_change(port_id_t port_id, bool is_up) {
     return status;
 }
 
+/**
+ * @brief Flush the ports a link event batch reports down
+ *
+ * @param batch Changed ports
+ * @param arg Unused
+ */
+static void mac_learning_link_batch(const link_event_batch_t *batch, void *arg) {
+    uint32_t flushed = 0;
+
+    (void)arg;
+
+    if (!g_mac_learning.initialized) {
+        return;
+    }
+
+    for (uint32_t w = 0; w < LINK_EVENT_PORT_WORDS; w++) {
+        uint64_t down = batch->changed[w] & ~batch->up[w];
+
+        while (down) {
+            port_id_t port_id = w * 64 + __builtin_ctzll(down);
+
+            down &= down - 1;
+            if (port_id < g_mac_learning.num_ports &&
+                mac_learning_flush(0, port_id) == STATUS_SUCCESS) {
+                flushed++;
+            }
+        }
+    }
+
+    if (flushed) {
+        LOG_INFO(LOG_CATEGORY_L2, "%u ports went down, dynamic MAC entries flushed", flushed);
+    }
+}
+
 /**
  * @brief Handle VLAN state change events
  *
@@ -4,23 +4,69 @@
  *
  * This file implements the MAC address table for the switch simulator,
  * including functions for adding, removing, searching, and aging MAC entries.
+ *
+ * Lookups take no lock. Buckets are grouped into stripes, each with a
+ * writer spinlock and a sequence counter; a writer makes the counter odd
+ * while it changes a bucket, and a reader retries if the counters of its
+ * two buckets were odd or moved while it read. Writers lock the stripes of
+ * the two candidate buckets, and only a displacement walk locks them all.
+ *
+ * Dynamic entries are aged by a two-level timing wheel of one-second ticks
+ * holding {key, deadline} items. When an item comes due its entry is
+ * removed, or re-queued at last_seen + aging_time if it was seen since, so
+ * an aging pass touches only the entries that are due.
+ *
+ * Lookups never write the buckets. A hit sets the entry's bit in a hit
+ * bitmap of the looking-up thread, and only if the bit is clear, so a
+ * busy entry costs one relaxed load per packet. Every aging tick takes the
+ * bits out of all bitmaps and moves last_seen of the entries hit since the
+ * previous tick forward.
+ *
+ * Every occupied slot is also on an intrusive list of its port and one of
+ * its VLAN, so flushing a port or VLAN walks only that port's or VLAN's
+ * entries. List links are guarded by per-list locks taken after stripe
+ * locks.
+ *
+ * With a banked hardware profile, new entries must also find room in an
+ * emulated d-left layout of hash banks, so learning fails where the
+ * modeled ASIC would even though the cuckoo table has space.
+ *
+ * Snapshots copy buckets with the same sequence checks as lookups. Only a
+ * displacement walk moves a key to another bucket, so it also bumps a
+ * table-wide sequence and a snapshot that saw it change starts over.
+ *
+ * A table that fills up grows by linear hashing: it doubles its buckets
+ * one split at a time, from learning and from the aging tick, while
+ * lookups go on. Buckets below the split point are addressed with the
+ * next level's mask; splitting bucket s moves the keys that now belong in
+ * s + N, N the buckets before the doubling, and s + N shares the stripe of
+ * s, so a split is an ordinary write section to readers. The buckets are
+ * stored in segments that never move, one per doubling, and a split only
+ * moves keys a split passed over, which snapshots read again further on.
  */
 
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #include "common/types.h"
+#include "common/config.h"
+#include "common/event_feed.h"
 #include "common/error_codes.h"
+#include "common/keyed_hash.h"
 #include "common/logging.h"
+#include "common/mem_account.h"
+#include "common/mem_arena.h"
+#include "common/switch_context.h"
 #include "common/threading.h"
+#include "common/trace.h"
 #include "hal/port.h"
 #include "l2/mac_table.h"
-
-/**
- * @brief Default size of the MAC table hash
- */
-#define MAC_TABLE_DEFAULT_SIZE 1024
+#include "l2/lag.h"
+#include "l2/vxlan.h"
 
 /**
  * @brief Default aging time in seconds
@@ -30,37 +76,295 @@
 /**
  * @brief Maximum number of MAC entries
  */
-#define MAC_TABLE_MAX_ENTRIES 16384
+#define MAC_TABLE_MAX_ENTRIES CONFIG_MAX_MAC_TABLE_ENTRIES
 
 /**
- * @brief Structure for MAC table entry
+ * @brief Slots per bucket; one bucket fills a cache line
  */
-typedef struct mac_entry {
-    mac_addr_t mac_addr;      // MAC address
-    port_id_t port_id;        // Port ID where this MAC was learned
-    vlan_id_t vlan_id;        // VLAN ID for this MAC
+#define MAC_BUCKET_SLOTS 4
+
+/**
+ * @brief Cache line size used to align buckets
+ */
+#define MAC_CACHE_LINE 64
+
+/**
+ * @brief Memory arena the buckets and entries of every instance come from
+ */
+#define MAC_TABLE_ARENA "mac_table"
+
+/**
+ * @brief Marks a key slot as occupied; an all-zero key is an empty slot
+ */
+#define MAC_KEY_VALID 0x8000
+
+/**
+ * @brief Displacements tried before an insert gives up
+ */
+#define MAC_CUCKOO_MAX_KICKS 128
+
+/**
+ * @brief Number of writer lock stripes (power of 2)
+ */
+#define MAC_TABLE_STRIPES 256
+
+/**
+ * @brief Aging wheel geometry: level 0 has one-second slots, level 1 has
+ * slots of MAC_WHEEL_L0_SLOTS seconds
+ */
+#define MAC_WHEEL_L0_BITS 8
+#define MAC_WHEEL_L1_BITS 6
+#define MAC_WHEEL_L0_SLOTS (1u << MAC_WHEEL_L0_BITS)
+#define MAC_WHEEL_L1_SLOTS (1u << MAC_WHEEL_L1_BITS)
+
+/**
+ * @brief Flush index list heads (powers of 2); IDs beyond them share lists
+ */
+#define MAC_INDEX_PORTS CONFIG_MAX_PORTS
+#define MAC_INDEX_VLANS 4096
+
+/**
+ * @brief End of an index list
+ */
+#define MAC_SLOT_NONE UINT32_MAX
+
+/**
+ * @brief Move count marking an entry frozen on its port
+ */
+#define MAC_MOVES_FROZEN 0xFF
+
+/**
+ * @brief Seconds without a move that halve an entry's move count
+ */
+#define MAC_MOVE_DECAY_TIME 1
+
+/**
+ * @brief Hit bitmaps per instance; threads beyond this many share them
+ */
+#define MAC_HIT_MAPS 16
+
+/**
+ * @brief Entries a table may grow to, 0 if tables keep their size
+ */
+#define MAC_TABLE_GROW_MAX CONFIG_MAC_TABLE_GROW_MAX_ENTRIES
+
+/**
+ * @brief Storage segments: the buckets a table starts with, then one per
+ * doubling
+ */
+#define MAC_SEGMENTS_MAX 24
+
+/**
+ * @brief Buckets split by a learning call, and by an aging tick, while the
+ * table doubles
+ */
+#define MAC_GROW_STEP 4
+#define MAC_GROW_TICK_STEP 256
+
+/**
+ * @brief Lock-free snapshot passes tried before copying under all stripes
+ */
+#define MAC_SNAPSHOT_RETRIES 4
+
+/**
+ * @brief Hardware bank location of an entry: bank index, MAC_HW_OVERFLOW
+ * set if it is in the bank's overflow, MAC_HW_NONE outside banked mode
+ */
+#define MAC_HW_OVERFLOW 0x80
+#define MAC_HW_NONE     0xFF
+
+/**
+ * @brief Per-bank hash seed multiplier
+ */
+#define MAC_HW_BANK_SEED 0x9E3779B97F4A7C15ULL
+
+/**
+ * @brief Lookup-hot part of an entry, 16 bytes so a bucket fills a line
+ *
+ * A key is the MAC address in bits 63..16, MAC_KEY_VALID and the VLAN ID
+ * in bits 15..0, so a lookup compares whole keys and finds the port in
+ * the same cache line.
+ */
+typedef struct {
+    uint64_t key;             // Packed key, 0 if the slot is empty
     uint32_t last_seen;       // Timestamp when this entry was last used
+    port_id_t port_id;        // Port ID where this MAC was learned
     bool is_static;           // Whether this is a static entry (doesn't age)
-    struct mac_entry *next;   // Pointer to next entry (for hash collisions)
+    uint8_t hw_loc;           // Emulated hardware bank location
+} mac_slot_t;
+
+_Static_assert(sizeof(mac_slot_t) == 16, "mac_slot_t must stay 16 bytes");
+
+/**
+ * @brief Bucket of hot entry slots
+ */
+typedef struct {
+    mac_slot_t slots[MAC_BUCKET_SLOTS];
+} __attribute__((aligned(MAC_CACHE_LINE))) mac_bucket_t;
+
+/**
+ * @brief Cold part of an entry (aging and move dampening), parallel to
+ * the hot slots
+ */
+typedef struct mac_entry {
+    uint32_t expires;         // Deadline of the entry's current aging wheel item
+    uint32_t move_time;       // Time of the last move, or end of the freeze if frozen
+    uint8_t moves;            // Recent port moves, MAC_MOVES_FROZEN while frozen
 } mac_entry_t;
 
+/**
+ * @brief Aging wheel item; stale items (entry removed or re-queued) are
+ * recognized by a missing key or a deadline different from entry->expires
+ */
+typedef struct {
+    uint64_t key;             // Packed key of the entry
+    uint32_t deadline;        // Second at which the entry may expire
+} mac_wheel_item_t;
+
+/**
+ * @brief Aging wheel slot, a growable array of items
+ */
+typedef struct {
+    mac_wheel_item_t *items;  // Items due in this slot
+    uint32_t count;           // Number of items
+    uint32_t capacity;        // Allocated items
+} mac_wheel_slot_t;
+
+/**
+ * @brief Flush indexes a slot is linked into
+ */
+enum {
+    MAC_INDEX_PORT = 0,
+    MAC_INDEX_VLAN,
+    MAC_INDEX_COUNT
+};
+
+/**
+ * @brief Index list links of a slot
+ */
+typedef struct {
+    uint32_t next;            // Next slot on the list, MAC_SLOT_NONE at the end
+    uint32_t prev;            // Previous slot, MAC_SLOT_NONE at the head
+} mac_link_t;
+
+/**
+ * @brief Index links of a slot, parallel to the key slots
+ */
+typedef struct {
+    mac_link_t link[MAC_INDEX_COUNT];
+} mac_links_t;
+
+/**
+ * @brief Storage of a run of buckets, see mac_segment()
+ */
+typedef struct {
+    mac_bucket_t *buckets;    // Hot entry slots
+    mac_entry_t *entries;     // Cold entry data, parallel to the slots
+    mac_links_t *links;       // Flush index links, parallel to the slots
+} mac_segment_t;
+
+/**
+ * @brief Head of one port or VLAN list
+ */
+typedef struct {
+    uint32_t head;            // First slot, MAC_SLOT_NONE if empty
+    spinlock_t lock;          // Guards the links of the list
+} mac_index_list_t;
+
+/**
+ * @brief Hierarchical aging wheel
+ */
+typedef struct {
+    mac_wheel_slot_t level0[MAC_WHEEL_L0_SLOTS]; // Deadlines within MAC_WHEEL_L0_SLOTS seconds
+    mac_wheel_slot_t level1[MAC_WHEEL_L1_SLOTS]; // Later deadlines, grouped by level 0 turn
+    uint32_t time;            // Last second processed
+    spinlock_t lock;          // Taken after stripe locks, never before
+} mac_wheel_t;
+
+/**
+ * @brief One emulated hardware hash bank
+ */
+typedef struct {
+    uint8_t *rows;            // Ways used in each row
+    uint32_t used;            // Row entries in use
+    uint32_t overflow_used;   // Overflow entries in use
+    uint32_t full_rows;       // Rows with every way in use
+    uint64_t row_collisions;  // Inserts that found the key's row full
+} mac_hw_bank_t;
+
+/**
+ * @brief Emulated hardware hash layout
+ */
+typedef struct {
+    mac_table_hw_profile_t profile; // Layout, MAC_TABLE_MODE_CUCKOO if not emulated
+    mac_hw_bank_t banks[MAC_TABLE_HW_MAX_BANKS];
+    spinlock_t lock;          // Taken after stripe locks, never before
+} mac_hw_model_t;
+
+/**
+ * @brief Writer lock and reader sequence for a stripe of buckets
+ */
+typedef struct {
+    spinlock_t lock;          // Serializes writers of the stripe's buckets
+    uint32_t seq;             // Odd while a writer changes a bucket
+} __attribute__((aligned(MAC_CACHE_LINE))) mac_stripe_t;
+
 
 /**
  * @brief Structure for MAC table
+ *
+ * Bucketized cuckoo hash: every key lives in one of two candidate buckets,
+ * and a bucket holds the hot part of its entries, so a lookup reads one
+ * cache line, two if the key is in its second bucket.
+ * count, static_count, aging_time, current_time, layout, size and
+ * max_entries are accessed atomically. hit_maps holds MAC_HIT_MAPS bitmaps
+ * of hit_words words, one bit per key slot the table can grow to.
  */
 typedef struct mac_table_internal {
-    mac_entry_t **entries;    // Array of entry pointers (hash table)
-    uint32_t size;            // Size of the hash table
+    mac_segment_t segments[MAC_SEGMENTS_MAX]; // Slot storage, segments[0].entries NULL until init
+    uint32_t segment_bits;    // log2 of the buckets in segment 0
+    uint64_t layout;          // Level mask << 32 | buckets of the level split so far
+    uint32_t size;            // Number of key slots
+    uint32_t max_entries;     // Entry limit
+    uint32_t grow_limit;      // Entry limit growth stops at, 0 if the table keeps its size
+    spinlock_t resize_lock;   // Serializes bucket splits, taken before stripe locks
     uint32_t count;           // Number of entries in the table
+    uint32_t static_count;    // Number of static entries
     uint32_t aging_time;      // Aging time in seconds
     uint32_t current_time;    // Current simulated time
-    spinlock_t lock;          // Lock for thread-safe access
+    mac_stripe_t stripes[MAC_TABLE_STRIPES]; // Writer locks, bucket & (MAC_TABLE_STRIPES - 1)
+    uint32_t displace_seq;    // Odd while a displacement walk moves keys between buckets
+    mac_wheel_t wheel;        // Aging wheel for dynamic entries
+    mac_index_list_t port_index[MAC_INDEX_PORTS]; // Slots by port_id & (MAC_INDEX_PORTS - 1)
+    mac_index_list_t vlan_index[MAC_INDEX_VLANS]; // Slots by vlan & (MAC_INDEX_VLANS - 1)
+    mac_move_event_t move_events[MAC_MOVE_EVENT_RING_SIZE]; // Recent freezes, oldest overwritten
+    uint32_t move_event_count;   // Events ever recorded
+    spinlock_t event_lock;       // Guards the move event ring and callback
+    mac_event_callback_t event_callback; // Event subscriber
+    void *event_user_data;       // Subscriber context
+    mac_hw_model_t hw;           // Emulated hardware bank layout
+    uint64_t learn_failures;     // New entries refused for lack of space
+    uint32_t generation;         // Bumped when an entry moves port or goes away
+    uint64_t *hit_maps;          // Slots hit since the last aging tick, by thread
+    uint32_t hit_words;          // Words per hit bitmap, a cache line multiple
 } mac_table_internal_t;
 
 /**
- * @brief The global MAC table instance
+ * @brief MAC table of each switch instance
+ *
+ * Instance 0 is static; mac_table_init() allocates the others.
+ */
+static mac_table_internal_t g_mac_table_default;
+static mac_table_internal_t *g_mac_tables[CONFIG_MAX_SWITCH_INSTANCES] = { &g_mac_table_default };
+
+/* Table of the instance the calling thread is bound to */
+#define g_mac_table (*g_mac_tables[switch_context_current()])
+
+/**
+ * @brief Hit bitmap of the calling thread, the same in every instance
  */
-static mac_table_internal_t g_mac_table;
+static __thread uint32_t t_mac_hit_map = UINT32_MAX;
+static uint32_t g_mac_hit_next;
 
 // The techniques whithout using in struct mac_table_internal_t improve the using 
 // of memory but, it is not be an OOP the variable use once
@@ -71,536 +375,2490 @@ static mac_table_internal_t g_mac_table;
 
 
 /**
- * @brief Acquire lock for MAC table access
+ * @brief Get the stripe guarding a bucket
  */
-static inline void mac_table_acquire_lock(void) {
-    spinlock_acquire(&g_mac_table.lock);
+static inline mac_stripe_t *mac_stripe(uint32_t bucket) {
+    return &g_mac_table.stripes[bucket & (MAC_TABLE_STRIPES - 1)];
 }
 
 /**
- * @brief Release lock for MAC table access
+ * @brief Lock the stripes of a key's two buckets, in address order
  */
-static inline void mac_table_release_lock(void) {
-    spinlock_release(&g_mac_table.lock);
+static void mac_table_lock_buckets(uint32_t b1, uint32_t b2) {
+    mac_stripe_t *first = mac_stripe(b1);
+    mac_stripe_t *second = mac_stripe(b2);
+
+    if (first > second) {
+        mac_stripe_t *tmp = first;
+        first = second;
+        second = tmp;
+    }
+    spinlock_acquire(&first->lock);
+    if (second != first) {
+        spinlock_acquire(&second->lock);
+    }
 }
 
 /**
- * @brief Simple hash function for MAC addresses
- *
- * @param mac MAC address to hash
- * @param vlan VLAN ID to include in hash
- * @return uint32_t Hash value
+ * @brief Unlock the stripes taken by mac_table_lock_buckets()
  */
-static uint32_t mac_hash(const mac_addr_t *mac, vlan_id_t vlan) {
-    uint32_t hash = 0;
-    
-    // Combine all bytes of the MAC address
-    for (int i = 0; i < MAC_ADDR_LEN; i++) {
-        hash = (hash << 3) ^ (hash >> 29) ^ (*mac).addr[i];
+static void mac_table_unlock_buckets(uint32_t b1, uint32_t b2) {
+    mac_stripe_t *first = mac_stripe(b1);
+    mac_stripe_t *second = mac_stripe(b2);
+
+    if (second != first) {
+        spinlock_release(&second->lock);
+    }
+    spinlock_release(&first->lock);
+}
+
+/**
+ * @brief Lock every stripe, for displacement walks and cleanup
+ */
+static void mac_table_lock_all(void) {
+    for (int i = 0; i < MAC_TABLE_STRIPES; i++) {
+        spinlock_acquire(&g_mac_table.stripes[i].lock);
     }
-    
-    // Include VLAN ID in the hash
-    hash = (hash << 5) ^ (hash >> 27) ^ vlan;
-    
-    return hash % g_mac_table.size;
 }
 
+/**
+ * @brief Unlock every stripe
+ */
+static void mac_table_unlock_all(void) {
+    for (int i = MAC_TABLE_STRIPES - 1; i >= 0; i--) {
+        spinlock_release(&g_mac_table.stripes[i].lock);
+    }
+}
 
 /**
- * @brief Get pointer to the global MAC table instance
- * @return Pointer to the global MAC table
+ * @brief Start changing a bucket; the caller holds its stripe lock
  */
-mac_table_internal_t* mac_table_get_instance(void) {
-    return &g_mac_table;
+static inline void mac_write_begin(uint32_t bucket) {
+    mac_stripe_t *stripe = mac_stripe(bucket);
+    __atomic_store_n(&stripe->seq, stripe->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
 }
 
+/**
+ * @brief Publish the changes made since mac_write_begin()
+ */
+static inline void mac_write_end(uint32_t bucket) {
+    mac_stripe_t *stripe = mac_stripe(bucket);
+    __atomic_store_n(&stripe->seq, stripe->seq + 1, __ATOMIC_RELEASE);
+}
 
 /**
- * @brief Initialize the MAC table
+ * @brief Pack a MAC address and VLAN into a table key
  *
- * @param size Hash table size (0 for default)
- * @param aging_time Aging time in seconds (0 for default)
- * @return status_t Status code
+ * @param mac MAC address
+ * @param vlan VLAN ID
+ * @return uint64_t Key, never 0
  */
-status_t mac_table_init(uint32_t size, uint32_t aging_time) {
-    LOG_INFO(LOG_CATEGORY_L2, "Initializing MAC table");
-    
-    // Use defaults if parameters are 0
-    if (size == 0) {
-        size = MAC_TABLE_DEFAULT_SIZE;
+static inline uint64_t mac_key(const mac_addr_t *mac, vlan_id_t vlan) {
+    uint64_t key = 0;
+
+    for (int i = 0; i < MAC_ADDR_LEN; i++) {
+        key = (key << 8) | mac->addr[i];
     }
-    
-    if (aging_time == 0) {
-        aging_time = MAC_DEFAULT_AGING_TIME;
+
+    return (key << 16) | MAC_KEY_VALID | (vlan & (MAC_KEY_VALID - 1));
+}
+
+/**
+ * @brief Unpack a table key
+ *
+ * @param key Key
+ * @param mac Receives the MAC address
+ * @param vlan Receives the VLAN ID
+ */
+static inline void mac_key_unpack(uint64_t key, mac_addr_t *mac, vlan_id_t *vlan) {
+    *vlan = (vlan_id_t)(key & (MAC_KEY_VALID - 1));
+    key >>= 16;
+    for (int i = MAC_ADDR_LEN - 1; i >= 0; i--) {
+        mac->addr[i] = (uint8_t)key;
+        key >>= 8;
     }
+}
 
-    // Initialize lock
-    spinlock_init(&g_mac_table.lock);
-    
-    // Allocate the hash table
-    g_mac_table.entries = (mac_entry_t**)calloc(size, sizeof(mac_entry_t*));
-    if (g_mac_table.entries == NULL) {
-        LOG_ERROR(LOG_CATEGORY_L2, "Failed to allocate memory for MAC table");
-        return STATUS_NO_MEMORY;
+/**
+ * @brief Hash function for MAC table keys
+ *
+ * Keyed, so learned addresses cannot be chosen to share buckets; the two
+ * halves select the two buckets.
+ *
+ * @param key Packed key
+ * @return uint64_t Hash value
+ */
+static inline uint64_t mac_hash(uint64_t key) {
+    return keyed_hash_u64(key);
+}
+
+/**
+ * @brief Get the bucket a hash half selects
+ *
+ * @param half Low or high half of a key hash
+ * @param layout Table layout, level mask and split point
+ * @return uint32_t Bucket; below the split point the next level's mask applies
+ */
+static inline uint32_t mac_bucket_index(uint32_t half, uint64_t layout) {
+    uint32_t mask = (uint32_t)(layout >> 32);
+    uint32_t bucket = half & mask;
+
+    if (bucket < (uint32_t)layout) {
+        bucket = half & (mask * 2 + 1);
     }
-    
-    g_mac_table.size = size;
-    g_mac_table.count = 0;
-    g_mac_table.aging_time = aging_time;
-    g_mac_table.current_time = 0;
-    
-    LOG_INFO(LOG_CATEGORY_L2, "MAC table initialized with size %u and aging time %u seconds", 
-            size, aging_time);
-            
-    return STATUS_SUCCESS;
+    return bucket;
 }
 
 /**
- * @brief Clean up and free the MAC table resources
+ * @brief Get the two candidate buckets of a key
  *
- * @return status_t Status code
+ * @param hash Key hash
+ * @param b1 Receives the primary bucket
+ * @param b2 Receives the secondary bucket; equal to b1 for the few keys
+ *           whose hash halves select the same bucket, which keeps every
+ *           key's buckets a function of the layout alone
  */
-status_t mac_table_cleanup(void) {
-    LOG_INFO(LOG_CATEGORY_L2, "Cleaning up MAC table");
-    
-    if (g_mac_table.entries == NULL) {
-        return STATUS_SUCCESS;  // Already cleaned up
+static inline void mac_buckets(uint64_t hash, uint32_t *b1, uint32_t *b2) {
+    uint64_t layout = __atomic_load_n(&g_mac_table.layout, __ATOMIC_ACQUIRE);
+
+    *b1 = mac_bucket_index((uint32_t)hash, layout);
+    *b2 = mac_bucket_index((uint32_t)(hash >> 32), layout);
+}
+
+/**
+ * @brief Get the number of buckets in use
+ */
+static inline uint32_t mac_bucket_count(void) {
+    uint64_t layout = __atomic_load_n(&g_mac_table.layout, __ATOMIC_ACQUIRE);
+    return (uint32_t)(layout >> 32) + 1 + (uint32_t)layout;
+}
+
+/**
+ * @brief Get the segment holding a bucket
+ *
+ * Segment 0 holds the 2^segment_bits buckets the table started with, and
+ * segment k >= 1 the buckets from 2^(segment_bits + k - 1) on that the
+ * k-th doubling added.
+ *
+ * @param table Table
+ * @param bucket Bucket index
+ * @param first Receives the index of the segment's first bucket
+ * @return mac_segment_t* Segment
+ */
+static inline mac_segment_t *mac_segment(mac_table_internal_t *table, uint32_t bucket, uint32_t *first) {
+    uint32_t high = bucket >> table->segment_bits;
+    uint32_t index = high ? 32 - (uint32_t)__builtin_clz(high) : 0;
+
+    *first = index ? 1u << (table->segment_bits + index - 1) : 0;
+    return &table->segments[index];
+}
+
+/**
+ * @brief Get a bucket
+ */
+static inline mac_bucket_t *mac_bucket(uint32_t bucket) {
+    uint32_t first;
+    mac_segment_t *segment = mac_segment(&g_mac_table, bucket, &first);
+    return &segment->buckets[bucket - first];
+}
+
+/**
+ * @brief Get the hot part of a slot
+ */
+static inline mac_slot_t *mac_slot(uint32_t slot) {
+    return &mac_bucket(slot / MAC_BUCKET_SLOTS)->slots[slot % MAC_BUCKET_SLOTS];
+}
+
+/**
+ * @brief Get the cold part of a slot
+ */
+static inline mac_entry_t *mac_entry(uint32_t slot) {
+    uint32_t first;
+    mac_segment_t *segment = mac_segment(&g_mac_table, slot / MAC_BUCKET_SLOTS, &first);
+    return &segment->entries[slot - first * MAC_BUCKET_SLOTS];
+}
+
+/**
+ * @brief Get the index links of a slot
+ */
+static inline mac_links_t *mac_links(uint32_t slot) {
+    uint32_t first;
+    mac_segment_t *segment = mac_segment(&g_mac_table, slot / MAC_BUCKET_SLOTS, &first);
+    return &segment->links[slot - first * MAC_BUCKET_SLOTS];
+}
+
+/**
+ * @brief Compare every slot of a bucket with a key
+ *
+ * @param bucket Bucket
+ * @param key Key to look for (0 finds empty slots)
+ * @return uint32_t Bit i set if slot i holds the key
+ */
+static inline uint32_t mac_bucket_match(const mac_bucket_t *bucket, uint64_t key) {
+#if defined(__AVX2__)
+    // Keys are the even 64-bit lanes of each pair of slots
+    __m256i k = _mm256_set1_epi64x((long long)key);
+    __m256i lo = _mm256_cmpeq_epi64(_mm256_load_si256((const __m256i *)&bucket->slots[0]), k);
+    __m256i hi = _mm256_cmpeq_epi64(_mm256_load_si256((const __m256i *)&bucket->slots[2]), k);
+    uint32_t lanes = (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(lo)) |
+                     ((uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4);
+    return (lanes & 1) | ((lanes >> 1) & 2) | ((lanes >> 2) & 4) | ((lanes >> 3) & 8);
+#elif defined(__SSE2__)
+    // SSE2 has no 64-bit compare: both 32-bit halves of the key must match
+    __m128i k = _mm_set1_epi64x((long long)key);
+    uint32_t mask = 0;
+    for (int i = 0; i < MAC_BUCKET_SLOTS; i++) {
+        __m128i eq = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)&bucket->slots[i]), k);
+        eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+        mask |= ((uint32_t)_mm_movemask_pd(_mm_castsi128_pd(eq)) & 1) << i;
     }
-    
-    mac_table_acquire_lock();
-    
-    // Free all entries
-    for (uint32_t i = 0; i < g_mac_table.size; i++) {
-        mac_entry_t *entry = g_mac_table.entries[i];
-        while (entry != NULL) {
-            mac_entry_t *next = entry->next;
-            free(entry);
-            entry = next;
-        }
+    return mask;
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < MAC_BUCKET_SLOTS; i++) {
+        mask |= (uint32_t)(bucket->slots[i].key == key) << i;
     }
-    
-    // Free the hash table
-    free(g_mac_table.entries);
-    g_mac_table.entries = NULL;
-    g_mac_table.count = 0;
-    
-    mac_table_release_lock();
-    
-    LOG_INFO(LOG_CATEGORY_L2, "MAC table cleanup complete");
-    
-    return STATUS_SUCCESS;
+    return mask;
+#endif
 }
 
 /**
- * @brief Add or update a MAC entry in the table
+ * @brief Find the slot holding a key
  *
- * @param mac MAC address
- * @param port_id Port ID
- * @param vlan_id VLAN ID
- * @param is_static Whether this is a static entry
+ * @param key Packed key
+ * @param hash Key hash
+ * @return int64_t Slot index, or -1 if not found
+ */
+static int64_t mac_table_find(uint64_t key, uint64_t hash) {
+    uint32_t b1, b2;
+    mac_buckets(hash, &b1, &b2);
+    __builtin_prefetch(mac_bucket(b2));
+
+    uint32_t match = mac_bucket_match(mac_bucket(b1), key);
+    if (match) {
+        return (int64_t)b1 * MAC_BUCKET_SLOTS + __builtin_ctz(match);
+    }
+
+    match = mac_bucket_match(mac_bucket(b2), key);
+    if (match) {
+        return (int64_t)b2 * MAC_BUCKET_SLOTS + __builtin_ctz(match);
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Get the key stored in a slot
+ */
+static inline uint64_t *mac_slot_key(uint32_t slot) {
+    return &mac_slot(slot)->key;
+}
+
+/**
+ * @brief Get the list of a port or VLAN
+ */
+static inline mac_index_list_t *mac_index_list(int index, uint32_t id) {
+    return index == MAC_INDEX_PORT ? &g_mac_table.port_index[id & (MAC_INDEX_PORTS - 1)]
+                                   : &g_mac_table.vlan_index[id & (MAC_INDEX_VLANS - 1)];
+}
+
+/**
+ * @brief Push a slot on a list
+ */
+static void mac_index_link(int index, uint32_t id, uint32_t slot) {
+    mac_index_list_t *list = mac_index_list(index, id);
+    mac_link_t *link = &mac_links(slot)->link[index];
+
+    spinlock_acquire(&list->lock);
+    link->prev = MAC_SLOT_NONE;
+    link->next = list->head;
+    if (list->head != MAC_SLOT_NONE) {
+        mac_links(list->head)->link[index].prev = slot;
+    }
+    list->head = slot;
+    spinlock_release(&list->lock);
+}
+
+/**
+ * @brief Take a slot off a list
+ */
+static void mac_index_unlink(int index, uint32_t id, uint32_t slot) {
+    mac_index_list_t *list = mac_index_list(index, id);
+    mac_link_t *link = &mac_links(slot)->link[index];
+
+    spinlock_acquire(&list->lock);
+    if (link->prev != MAC_SLOT_NONE) {
+        mac_links(link->prev)->link[index].next = link->next;
+    } else {
+        list->head = link->next;
+    }
+    if (link->next != MAC_SLOT_NONE) {
+        mac_links(link->next)->link[index].prev = link->prev;
+    }
+    spinlock_release(&list->lock);
+}
+
+/**
+ * @brief Make a list refer to a slot's new position after a move
+ */
+static void mac_index_move(int index, uint32_t id, uint32_t from, uint32_t to) {
+    mac_index_list_t *list = mac_index_list(index, id);
+    mac_link_t *link = &mac_links(to)->link[index];
+
+    spinlock_acquire(&list->lock);
+    *link = mac_links(from)->link[index];
+    if (link->prev != MAC_SLOT_NONE) {
+        mac_links(link->prev)->link[index].next = to;
+    } else {
+        list->head = to;
+    }
+    if (link->next != MAC_SLOT_NONE) {
+        mac_links(link->next)->link[index].prev = to;
+    }
+    spinlock_release(&list->lock);
+}
+
+/**
+ * @brief Get the VLAN stored in a key
+ */
+static inline uint32_t mac_key_vlan(uint64_t key) {
+    return (uint32_t)(key & (MAC_KEY_VALID - 1));
+}
+
+/**
+ * @brief Link a newly stored slot into its port and VLAN lists
+ */
+static void mac_index_add(uint32_t slot) {
+    mac_index_link(MAC_INDEX_PORT, mac_slot(slot)->port_id, slot);
+    mac_index_link(MAC_INDEX_VLAN, mac_key_vlan(*mac_slot_key(slot)), slot);
+}
+
+/**
+ * @brief Unlink a slot that is about to be cleared
+ */
+static void mac_index_remove(uint32_t slot) {
+    mac_index_unlink(MAC_INDEX_PORT, mac_slot(slot)->port_id, slot);
+    mac_index_unlink(MAC_INDEX_VLAN, mac_key_vlan(*mac_slot_key(slot)), slot);
+}
+
+/**
+ * @brief Take a free slot in a bucket
+ *
+ * @param bucket Bucket index
+ * @return int64_t Slot index, or -1 if the bucket is full
+ */
+static inline int64_t mac_bucket_free_slot(uint32_t bucket) {
+    uint32_t empty = mac_bucket_match(mac_bucket(bucket), 0);
+    return empty ? (int64_t)bucket * MAC_BUCKET_SLOTS + __builtin_ctz(empty) : -1;
+}
+
+/**
+ * @brief Write an entry to a slot inside a write section
+ *
+ * @param slot Slot index; the caller holds the stripe lock of its bucket
+ * @param hot Hot entry part including the key, NULL to clear the slot
+ * @param cold Cold entry part, NULL to leave it unchanged
+ */
+static inline void mac_slot_store(uint32_t slot, const mac_slot_t *hot, const mac_entry_t *cold) {
+    uint32_t bucket = slot / MAC_BUCKET_SLOTS;
+
+    mac_write_begin(bucket);
+    if (cold != NULL) {
+        *mac_entry(slot) = *cold;
+    }
+    if (hot != NULL) {
+        *mac_slot(slot) = *hot;
+    } else {
+        memset(mac_slot(slot), 0, sizeof(mac_slot_t));
+    }
+    mac_write_end(bucket);
+}
+
+/**
+ * @brief Store a new key in a free slot of one of its buckets
+ *
+ * @param hash Key hash
+ * @param hot Hot entry part; its key is not present in the table
+ * @param cold Cold entry part
+ * @return bool true if stored, false if both buckets are full
+ */
+static bool mac_table_insert_direct(uint64_t hash, const mac_slot_t *hot, const mac_entry_t *cold) {
+    uint32_t b1, b2;
+    int64_t slot;
+
+    mac_buckets(hash, &b1, &b2);
+    slot = mac_bucket_free_slot(b1);
+    if (slot < 0) {
+        slot = mac_bucket_free_slot(b2);
+    }
+    if (slot < 0) {
+        return false;
+    }
+
+    mac_slot_store((uint32_t)slot, hot, cold);
+    mac_index_add((uint32_t)slot);
+    return true;
+}
+
+/**
+ * @brief Store a new key by displacing keys to their other bucket
+ *
+ * The displacement path is found first without changing the table, then
+ * keys are moved starting from the free end, so every key stays in one of
+ * its buckets during the moves and lock-free readers always find it. The
+ * caller holds every stripe lock.
+ *
+ * @param hash Key hash
+ * @param hot Hot entry part; its key is not present in the table
+ * @param cold Cold entry part
+ * @return bool true if stored, false if no room was found
+ */
+static bool mac_table_insert_path(uint64_t hash, const mac_slot_t *hot, const mac_entry_t *cold) {
+    uint32_t path[MAC_CUCKOO_MAX_KICKS];
+    uint32_t b1, b2;
+    uint32_t bucket;
+    int64_t slot = -1;
+    int depth = 0;
+
+    mac_buckets(hash, &b1, &b2);
+    bucket = b1;
+
+    while (depth < MAC_CUCKOO_MAX_KICKS) {
+        // Pick a victim that is not already on the path
+        uint32_t victim = 0;
+        bool found = false;
+        for (uint32_t i = 0; i < MAC_BUCKET_SLOTS && !found; i++) {
+            victim = bucket * MAC_BUCKET_SLOTS + ((uint32_t)(hash >> 8) + depth + i) % MAC_BUCKET_SLOTS;
+            found = true;
+            for (int j = 0; j < depth; j++) {
+                if (path[j] == victim) {
+                    found = false;
+                    break;
+                }
+            }
+        }
+        if (!found) {
+            return false;
+        }
+        path[depth++] = victim;
+
+        // The victim would move to its other bucket
+        uint32_t v1, v2;
+        mac_buckets(mac_hash(*mac_slot_key(victim)), &v1, &v2);
+        bucket = (bucket == v1) ? v2 : v1;
+
+        slot = mac_bucket_free_slot(bucket);
+        if (slot >= 0) {
+            break;
+        }
+    }
+    if (slot < 0) {
+        return false;
+    }
+
+    // Copy each victim forward before its old slot is overwritten
+    uint32_t free_slot = (uint32_t)slot;
+    __atomic_store_n(&g_mac_table.displace_seq, g_mac_table.displace_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (int i = depth - 1; i >= 0; i--) {
+        mac_slot_store(free_slot, mac_slot(path[i]), mac_entry(path[i]));
+        mac_index_move(MAC_INDEX_PORT, mac_slot(free_slot)->port_id, path[i], free_slot);
+        mac_index_move(MAC_INDEX_VLAN, mac_key_vlan(*mac_slot_key(free_slot)), path[i], free_slot);
+        free_slot = path[i];
+    }
+    mac_slot_store(free_slot, hot, cold);
+    mac_index_add(free_slot);
+    __atomic_store_n(&g_mac_table.displace_seq, g_mac_table.displace_seq + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/**
+ * @brief Append an item to a wheel slot
+ *
+ * @return bool false if the slot could not grow
+ */
+static bool mac_wheel_slot_push(mac_wheel_slot_t *slot, uint64_t key, uint32_t deadline) {
+    if (slot->count == slot->capacity) {
+        uint32_t capacity = slot->capacity ? slot->capacity * 2 : 16;
+        mac_wheel_item_t *items = (mac_wheel_item_t *)mem_realloc(MEM_TAG_MAC_TABLE, slot->items, capacity * sizeof(mac_wheel_item_t));
+        if (items == NULL) {
+            return false;
+        }
+        slot->items = items;
+        slot->capacity = capacity;
+    }
+
+    slot->items[slot->count].key = key;
+    slot->items[slot->count].deadline = deadline;
+    slot->count++;
+    return true;
+}
+
+/**
+ * @brief Queue an item in the slot matching its deadline
+ *
+ * Deadlines already passed go to the next tick; deadlines beyond the last
+ * level 1 slot go there and are re-filed when it is reached.
+ * The caller holds the wheel lock.
+ */
+static bool mac_wheel_insert_locked(mac_wheel_t *wheel, uint64_t key, uint32_t deadline) {
+    uint32_t when = deadline;
+
+    if ((int32_t)(when - wheel->time) <= 0) {
+        when = wheel->time + 1;
+    }
+
+    if (when - wheel->time < MAC_WHEEL_L0_SLOTS) {
+        return mac_wheel_slot_push(&wheel->level0[when & (MAC_WHEEL_L0_SLOTS - 1)], key, deadline);
+    }
+
+    uint32_t turns = (when >> MAC_WHEEL_L0_BITS) - (wheel->time >> MAC_WHEEL_L0_BITS);
+    if (turns >= MAC_WHEEL_L1_SLOTS) {
+        when = wheel->time + ((MAC_WHEEL_L1_SLOTS - 1) << MAC_WHEEL_L0_BITS);
+    }
+    return mac_wheel_slot_push(&wheel->level1[(when >> MAC_WHEEL_L0_BITS) & (MAC_WHEEL_L1_SLOTS - 1)],
+                                key, deadline);
+}
+
+/**
+ * @brief Queue a dynamic entry for aging
+ *
+ * @param key Packed key
+ * @param deadline Second at which the entry may expire
+ */
+static void mac_wheel_insert(uint64_t key, uint32_t deadline) {
+    mac_wheel_t *wheel = &g_mac_table.wheel;
+
+    spinlock_acquire(&wheel->lock);
+    bool queued = mac_wheel_insert_locked(wheel, key, deadline);
+    spinlock_release(&wheel->lock);
+
+    if (!queued) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Failed to queue MAC entry for aging");
+    }
+}
+
+/**
+ * @brief Drop every queued item and free the wheel slots
+ */
+static void mac_wheel_free(mac_wheel_t *wheel) {
+    for (uint32_t i = 0; i < MAC_WHEEL_L0_SLOTS; i++) {
+        mem_free(MEM_TAG_MAC_TABLE, wheel->level0[i].items);
+    }
+    for (uint32_t i = 0; i < MAC_WHEEL_L1_SLOTS; i++) {
+        mem_free(MEM_TAG_MAC_TABLE, wheel->level1[i].items);
+    }
+    memset(wheel->level0, 0, sizeof(wheel->level0));
+    memset(wheel->level1, 0, sizeof(wheel->level1));
+}
+
+/**
+ * @brief Account a port move of a dynamic entry
+ *
+ * The move count decays by half per MAC_MOVE_DECAY_TIME seconds, so only
+ * moves close together add up to CONFIG_MAC_MOVE_THRESHOLD.
+ *
+ * @param updated Entry being written; receives the new move state
+ * @param entry Current entry
+ * @param now Current time
+ * @param frozen_now Set to true if this move froze the entry
+ * @return bool true if the entry may move
+ */
+static bool mac_entry_note_move(mac_entry_t *updated, const mac_entry_t *entry, uint32_t now,
+                                bool *frozen_now) {
+    uint32_t moves = entry->moves;
+
+    if (moves == MAC_MOVES_FROZEN) {
+        if ((int32_t)(now - entry->move_time) < 0) {
+            return false;
+        }
+        moves = 0;
+    } else {
+        uint32_t halvings = (now - entry->move_time) / MAC_MOVE_DECAY_TIME;
+        moves = halvings >= 8 ? 0 : moves >> halvings;
+    }
+
+    if (++moves >= CONFIG_MAC_MOVE_THRESHOLD) {
+        updated->moves = MAC_MOVES_FROZEN;
+        updated->move_time = now + CONFIG_MAC_MOVE_FREEZE_TIME;
+        *frozen_now = true;
+        return false;
+    }
+
+    updated->moves = (uint8_t)moves;
+    updated->move_time = now;
+    return true;
+}
+
+/**
+ * @brief Record a freeze in the event ring and tell the subscriber
+ *
+ * Called without stripe locks held.
+ */
+static void mac_table_report_freeze(const mac_move_event_t *event) {
+    mac_event_callback_t callback;
+    void *user_data;
+
+    spinlock_acquire(&g_mac_table.event_lock);
+    g_mac_table.move_events[g_mac_table.move_event_count % MAC_MOVE_EVENT_RING_SIZE] = *event;
+    g_mac_table.move_event_count++;
+    callback = g_mac_table.event_callback;
+    user_data = g_mac_table.event_user_data;
+    spinlock_release(&g_mac_table.event_lock);
+
+    LOG_WARNING(LOG_CATEGORY_L2, "MAC %02x:%02x:%02x:%02x:%02x:%02x VLAN %u is flapping, frozen on port %u for %u seconds",
+               event->mac_addr.addr[0], event->mac_addr.addr[1], event->mac_addr.addr[2],
+               event->mac_addr.addr[3], event->mac_addr.addr[4], event->mac_addr.addr[5],
+               event->vlan_id, event->port_id, CONFIG_MAC_MOVE_FREEZE_TIME);
+
+    if (callback != NULL) {
+        mac_table_entry_t info;
+        memset(&info, 0, sizeof(info));
+        info.mac_addr = event->mac_addr;
+        info.vlan_id = event->vlan_id;
+        info.port_id = event->port_id;
+        info.type = MAC_ENTRY_TYPE_DYNAMIC;
+        info.aging = MAC_AGING_ACTIVE;
+        info.age_timestamp = event->timestamp;
+        callback(&info, true, user_data);
+    }
+}
+
+/**
+ * @brief Tell the subscriber a dynamic entry was learned, moved or aged out
+ *
+ * Called without stripe locks held. Costs one load when nobody subscribed,
+ * plus one for the event feed.
+ */
+static inline void mac_table_notify(const mac_addr_t *mac, vlan_id_t vlan_id, port_id_t port_id,
+                                    uint32_t timestamp, bool is_added) {
+    mac_event_callback_t callback = __atomic_load_n(&g_mac_table.event_callback, __ATOMIC_ACQUIRE);
+    event_feed_kind_t kind = is_added ? EVENT_FEED_MAC_LEARN : EVENT_FEED_MAC_AGE;
+
+    if (event_feed_enabled(kind)) {
+        event_feed_post_mac(kind, mac, vlan_id, port_id);
+    }
+
+    if (callback == NULL) {
+        return;
+    }
+
+    mac_table_entry_t info;
+    memset(&info, 0, sizeof(info));
+    info.mac_addr = *mac;
+    info.vlan_id = vlan_id;
+    info.port_id = port_id;
+    info.type = MAC_ENTRY_TYPE_DYNAMIC;
+    info.aging = MAC_AGING_ACTIVE;
+    info.age_timestamp = timestamp;
+    callback(&info, is_added, __atomic_load_n(&g_mac_table.event_user_data, __ATOMIC_RELAXED));
+}
+
+/**
+ * @brief Get pointer to the global MAC table instance
+ * @return Pointer to the global MAC table
+ */
+mac_table_internal_t* mac_table_get_instance(void) {
+    return &g_mac_table;
+}
+
+
+/**
+ * @brief Row of a key in an emulated hardware bank
+ */
+static inline uint32_t mac_hw_row(uint64_t key, uint32_t bank) {
+    return (uint32_t)(mac_hash(key ^ (MAC_HW_BANK_SEED * (bank + 1))) % g_mac_table.hw.profile.rows);
+}
+
+/**
+ * @brief Place a new key in the emulated hardware banks
+ *
+ * @param key Packed key
+ * @param loc Receives the entry's hardware location
+ * @return bool false if every candidate row and overflow is full
+ */
+static bool mac_hw_alloc(uint64_t key, uint8_t *loc) {
+    mac_hw_model_t *hw = &g_mac_table.hw;
+    uint32_t rows[MAC_TABLE_HW_MAX_BANKS];
+    uint32_t best = MAC_HW_NONE;
+    bool placed = true;
+
+    *loc = MAC_HW_NONE;
+    if (hw->profile.mode != MAC_TABLE_MODE_BANKED) {
+        return true;
+    }
+
+    for (uint32_t b = 0; b < hw->profile.banks; b++) {
+        rows[b] = mac_hw_row(key, b);
+    }
+
+    spinlock_acquire(&hw->lock);
+    for (uint32_t b = 0; b < hw->profile.banks; b++) {
+        uint8_t used = hw->banks[b].rows[rows[b]];
+        if (used == hw->profile.ways) {
+            hw->banks[b].row_collisions++;
+        } else if (best == MAC_HW_NONE || used < hw->banks[best].rows[rows[best]]) {
+            best = b;
+        }
+    }
+
+    if (best != MAC_HW_NONE) {
+        mac_hw_bank_t *bank = &hw->banks[best];
+        if (++bank->rows[rows[best]] == hw->profile.ways) {
+            bank->full_rows++;
+        }
+        bank->used++;
+        *loc = (uint8_t)best;
+    } else {
+        placed = false;
+        for (uint32_t b = 0; b < hw->profile.banks; b++) {
+            if (hw->banks[b].overflow_used < hw->profile.overflow) {
+                hw->banks[b].overflow_used++;
+                *loc = (uint8_t)(b | MAC_HW_OVERFLOW);
+                placed = true;
+                break;
+            }
+        }
+    }
+    spinlock_release(&hw->lock);
+
+    return placed;
+}
+
+/**
+ * @brief Release the hardware location of a key
+ */
+static void mac_hw_free(uint64_t key, uint8_t loc) {
+    mac_hw_model_t *hw = &g_mac_table.hw;
+
+    if (loc == MAC_HW_NONE) {
+        return;
+    }
+
+    uint32_t b = loc & ~MAC_HW_OVERFLOW;
+    mac_hw_bank_t *bank = &hw->banks[b];
+    uint32_t row = (loc & MAC_HW_OVERFLOW) ? 0 : mac_hw_row(key, b);
+
+    spinlock_acquire(&hw->lock);
+    if (loc & MAC_HW_OVERFLOW) {
+        bank->overflow_used--;
+    } else {
+        if (bank->rows[row]-- == hw->profile.ways) {
+            bank->full_rows--;
+        }
+        bank->used--;
+    }
+    spinlock_release(&hw->lock);
+}
+
+/**
+ * @brief Release the emulated hardware banks
+ */
+static void mac_hw_free_banks(void) {
+    for (uint32_t b = 0; b < MAC_TABLE_HW_MAX_BANKS; b++) {
+        mem_free(MEM_TAG_MAC_TABLE, g_mac_table.hw.banks[b].rows);
+    }
+    memset(g_mac_table.hw.banks, 0, sizeof(g_mac_table.hw.banks));
+    memset(&g_mac_table.hw.profile, 0, sizeof(g_mac_table.hw.profile));
+    g_mac_table.hw.profile.mode = MAC_TABLE_MODE_CUCKOO;
+}
+
+/**
+ * @brief Get the number of buckets a segment holds
+ */
+static inline uint32_t mac_segment_buckets(uint32_t index) {
+    return 1u << (index ? g_mac_table.segment_bits + index - 1 : g_mac_table.segment_bits);
+}
+
+/**
+ * @brief Allocate the storage of a segment
+ *
+ * @param index Segment index
+ * @return bool false if memory ran out; nothing is left allocated then
+ */
+static bool mac_segment_alloc(uint32_t index) {
+    mem_arena_t *arena = mem_arena_get(MAC_TABLE_ARENA);
+    mac_segment_t *segment = &g_mac_table.segments[index];
+    size_t buckets = mac_segment_buckets(index);
+    size_t slots = buckets * MAC_BUCKET_SLOTS;
+
+    // The arena hands out zeroed memory on huge pages
+    segment->buckets = (mac_bucket_t *)mem_arena_alloc(arena, buckets * sizeof(mac_bucket_t), MAC_CACHE_LINE);
+    segment->entries = (mac_entry_t *)mem_arena_alloc(arena, slots * sizeof(mac_entry_t), 0);
+    segment->links = (mac_links_t *)mem_arena_alloc(arena, slots * sizeof(mac_links_t), 0);
+    if (segment->buckets == NULL || segment->entries == NULL || segment->links == NULL) {
+        mem_arena_free(arena, segment->buckets, buckets * sizeof(mac_bucket_t));
+        mem_arena_free(arena, segment->entries, slots * sizeof(mac_entry_t));
+        mem_arena_free(arena, segment->links, slots * sizeof(mac_links_t));
+        memset(segment, 0, sizeof(*segment));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Release the MAC table storage
+ */
+static void mac_table_free_storage(void) {
+    mem_arena_t *arena = mem_arena_get(MAC_TABLE_ARENA);
+
+    for (uint32_t i = 0; i < MAC_SEGMENTS_MAX; i++) {
+        mac_segment_t *segment = &g_mac_table.segments[i];
+        size_t buckets;
+
+        // Unallocated segments have nothing to free, and their sizes may not even fit a shift
+        if (segment->buckets == NULL) {
+            continue;
+        }
+        buckets = mac_segment_buckets(i);
+        mem_arena_free(arena, segment->buckets, buckets * sizeof(mac_bucket_t));
+        mem_arena_free(arena, segment->entries, buckets * MAC_BUCKET_SLOTS * sizeof(mac_entry_t));
+        mem_arena_free(arena, segment->links, buckets * MAC_BUCKET_SLOTS * sizeof(mac_links_t));
+        memset(segment, 0, sizeof(*segment));
+    }
+    mem_arena_free(arena, g_mac_table.hit_maps,
+                   (size_t)MAC_HIT_MAPS * g_mac_table.hit_words * sizeof(uint64_t));
+    g_mac_table.hit_maps = NULL;
+    mac_wheel_free(&g_mac_table.wheel);
+    mac_hw_free_banks();
+}
+
+/**
+ * @brief Initialize the MAC table
+ *
+ * @param size Maximum number of entries (0 for default)
+ * @param aging_time Aging time in seconds (0 for default)
+ * @return status_t Status code
+ */
+status_t mac_table_init(uint32_t size, uint32_t aging_time) {
+    LOG_INFO(LOG_CATEGORY_L2, "Initializing MAC table");
+    keyed_hash_init();
+    
+    // Use defaults if parameters are 0
+    if (size == 0 || size > MAC_TABLE_MAX_ENTRIES) {
+        size = MAC_TABLE_MAX_ENTRIES;
+    }
+    
+    if (aging_time == 0) {
+        aging_time = MAC_DEFAULT_AGING_TIME;
+    }
+
+    uint32_t instance = switch_context_current();
+    if (g_mac_tables[instance] == NULL) {
+        if ((g_mac_tables[instance] = mem_aligned_alloc(MEM_TAG_MAC_TABLE, MAC_CACHE_LINE, sizeof(mac_table_internal_t))) == NULL) {
+            g_mac_tables[instance] = NULL;
+            LOG_ERROR(LOG_CATEGORY_L2, "Failed to allocate MAC table of switch instance %u", instance);
+            return STATUS_NO_MEMORY;
+        }
+        memset(g_mac_tables[instance], 0, sizeof(mac_table_internal_t));
+    }
+
+    // Initialize stripe locks
+    for (int i = 0; i < MAC_TABLE_STRIPES; i++) {
+        spinlock_init(&g_mac_table.stripes[i].lock);
+        spinlock_set_class(&g_mac_table.stripes[i].lock, "mac_table.stripe");
+        g_mac_table.stripes[i].seq = 0;
+    }
+    spinlock_init(&g_mac_table.wheel.lock);
+    spinlock_set_class(&g_mac_table.wheel.lock, "mac_table.aging");
+    g_mac_table.wheel.time = 0;
+    spinlock_init(&g_mac_table.event_lock);
+    spinlock_set_class(&g_mac_table.event_lock, "mac_table.events");
+    g_mac_table.move_event_count = 0;
+    spinlock_init(&g_mac_table.hw.lock);
+    spinlock_set_class(&g_mac_table.hw.lock, "mac_table.hw");
+    g_mac_table.hw.profile.mode = MAC_TABLE_MODE_CUCKOO;
+    g_mac_table.learn_failures = 0;
+    for (uint32_t i = 0; i < MAC_INDEX_PORTS; i++) {
+        g_mac_table.port_index[i].head = MAC_SLOT_NONE;
+        spinlock_init(&g_mac_table.port_index[i].lock);
+        spinlock_set_class(&g_mac_table.port_index[i].lock, "mac_table.port_index");
+    }
+    for (uint32_t i = 0; i < MAC_INDEX_VLANS; i++) {
+        g_mac_table.vlan_index[i].head = MAC_SLOT_NONE;
+        spinlock_init(&g_mac_table.vlan_index[i].lock);
+        spinlock_set_class(&g_mac_table.vlan_index[i].lock, "mac_table.vlan_index");
+    }
+    
+    // Size the buckets for at most ~80% load so displacement walks stay short.
+    // A table that may grow starts with a bucket per stripe, so a bucket
+    // and the one it splits into always share a stripe
+    uint32_t grow_limit = MAC_TABLE_GROW_MAX > size ? MAC_TABLE_GROW_MAX : 0;
+    uint32_t buckets = grow_limit ? MAC_TABLE_STRIPES : 2;
+    while ((uint64_t)buckets * MAC_BUCKET_SLOTS * 4 < (uint64_t)size * 5) {
+        buckets <<= 1;
+    }
+    uint32_t slots = buckets * MAC_BUCKET_SLOTS;
+
+    // Hit bitmaps cover every slot the table can grow to
+    uint32_t max_buckets = buckets;
+    while ((uint64_t)max_buckets * MAC_BUCKET_SLOTS * 4 < (uint64_t)grow_limit * 5 &&
+           (uint32_t)__builtin_ctz(max_buckets) - __builtin_ctz(buckets) + 1 < MAC_SEGMENTS_MAX) {
+        max_buckets <<= 1;
+    }
+    if ((uint64_t)grow_limit * 5 > (uint64_t)max_buckets * MAC_BUCKET_SLOTS * 4) {
+        grow_limit = (uint32_t)((uint64_t)max_buckets * MAC_BUCKET_SLOTS * 4 / 5);
+    }
+
+    g_mac_table.segment_bits = (uint32_t)__builtin_ctz(buckets);
+    g_mac_table.layout = (uint64_t)(buckets - 1) << 32;
+    g_mac_table.grow_limit = grow_limit;
+    spinlock_init(&g_mac_table.resize_lock);
+    spinlock_set_class(&g_mac_table.resize_lock, "mac_table.resize");
+    mem_arena_t *arena = mem_arena_get(MAC_TABLE_ARENA);
+    g_mac_table.hit_words = (((size_t)max_buckets * MAC_BUCKET_SLOTS + 63) / 64 + 7) & ~7u;
+    g_mac_table.hit_maps = (uint64_t *)mem_arena_alloc(
+        arena, (size_t)MAC_HIT_MAPS * g_mac_table.hit_words * sizeof(uint64_t), MAC_CACHE_LINE);
+    g_mac_table.size = slots;
+    if (!mac_segment_alloc(0) || g_mac_table.hit_maps == NULL) {
+        mac_table_free_storage();
+        LOG_ERROR(LOG_CATEGORY_L2, "Failed to allocate memory for MAC table");
+        return STATUS_NO_MEMORY;
+    }
+    
+    g_mac_table.max_entries = size;
+    g_mac_table.count = 0;
+    g_mac_table.static_count = 0;
+    g_mac_table.aging_time = aging_time;
+    g_mac_table.current_time = 0;
+    
+    LOG_INFO(LOG_CATEGORY_L2, "MAC table initialized with %u entries (%u buckets) and aging time %u seconds", 
+            size, buckets, aging_time);
+    if (grow_limit) {
+        LOG_INFO(LOG_CATEGORY_L2, "MAC table may grow to %u entries", grow_limit);
+    }
+            
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Clean up and free the MAC table resources
+ *
+ * @return status_t Status code
+ */
+status_t mac_table_cleanup(void) {
+    uint32_t instance = switch_context_current();
+
+    LOG_INFO(LOG_CATEGORY_L2, "Cleaning up MAC table");
+    
+    if (g_mac_tables[instance] == NULL || g_mac_table.segments[0].entries == NULL) {
+        return STATUS_SUCCESS;  // Already cleaned up
+    }
+    
+    mac_table_lock_all();
+    
+    // Free the hash table
+    mac_table_free_storage();
+    g_mac_table.count = 0;
+    g_mac_table.static_count = 0;
+    
+    mac_table_unlock_all();
+
+    if (instance != SWITCH_INSTANCE_DEFAULT) {
+        mem_free(MEM_TAG_MAC_TABLE, g_mac_tables[instance]);
+        g_mac_tables[instance] = NULL;
+    }
+    
+    LOG_INFO(LOG_CATEGORY_L2, "MAC table cleanup complete");
+    
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Deinitialize the MAC address table, see mac_table_cleanup()
+ *
+ * @return status_t STATUS_SUCCESS on success
+ */
+status_t mac_table_deinit(void) {
+    return mac_table_cleanup();
+}
+
+/**
+ * @brief Split the next bucket of the doubling in progress
+ *
+ * The keys of bucket s that the next level's mask sends to s + N, N the
+ * buckets before the doubling, move there. s + N was never addressed
+ * before, so it is empty and they all fit. One write section on the
+ * stripe both buckets share covers the moves and the new split point, so
+ * a reader sees the keys where its layout says or retries. The caller
+ * holds the resize lock.
+ */
+static void mac_table_split_bucket(void) {
+    uint64_t layout = g_mac_table.layout;
+    uint32_t mask = (uint32_t)(layout >> 32);
+    uint32_t from = (uint32_t)layout;
+    uint32_t to = from + mask + 1;
+    uint32_t moved = 0;
+    mac_stripe_t *stripe = mac_stripe(from);
+
+    spinlock_acquire(&stripe->lock);
+    mac_write_begin(from);
+    for (uint32_t i = from * MAC_BUCKET_SLOTS; i < (from + 1) * MAC_BUCKET_SLOTS; i++) {
+        mac_slot_t *hot = mac_slot(i);
+        if (hot->key == 0) {
+            continue;
+        }
+
+        // The hash half that put the key here picks its bucket again
+        uint64_t hash = mac_hash(hot->key);
+        uint32_t half = ((uint32_t)hash & mask) == from ? (uint32_t)hash : (uint32_t)(hash >> 32);
+        if ((half & (mask * 2 + 1)) == from) {
+            continue;
+        }
+
+        uint32_t slot = to * MAC_BUCKET_SLOTS + moved++;
+        *mac_entry(slot) = *mac_entry(i);
+        *mac_slot(slot) = *hot;
+        mac_index_move(MAC_INDEX_PORT, hot->port_id, i, slot);
+        mac_index_move(MAC_INDEX_VLAN, mac_key_vlan(hot->key), i, slot);
+        memset(hot, 0, sizeof(*hot));
+    }
+    layout = from == mask ? (uint64_t)(mask * 2 + 1) << 32 : layout + 1;
+    __atomic_store_n(&g_mac_table.layout, layout, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_mac_table.size, g_mac_table.size + MAC_BUCKET_SLOTS, __ATOMIC_RELEASE);
+    mac_write_end(from);
+    spinlock_release(&stripe->lock);
+}
+
+/**
+ * @brief Grow the table by a few buckets
+ *
+ * A doubling starts once the entries reach three quarters of the entry
+ * limit, with the allocation of the segment it fills; then every call
+ * splits up to steps buckets of it, and raises the entry limit to four
+ * fifths of the slots, the load init sizes a table for. A call that finds
+ * another thread growing the table leaves it to that thread.
+ *
+ * @param steps Buckets to split at most
+ */
+static void mac_table_grow(uint32_t steps) {
+    uint32_t limit = __atomic_load_n(&g_mac_table.max_entries, __ATOMIC_RELAXED);
+    uint64_t layout = __atomic_load_n(&g_mac_table.layout, __ATOMIC_RELAXED);
+    uint32_t buckets = (uint32_t)(layout >> 32) + 1;
+    uint32_t index = 32 - (uint32_t)__builtin_clz(buckets >> g_mac_table.segment_bits);
+
+    if (g_mac_table.grow_limit == 0 || index >= MAC_SEGMENTS_MAX) {
+        return;
+    }
+    // Between doublings, wait until the table fills up
+    if ((uint32_t)layout == 0 && g_mac_table.segments[index].buckets == NULL &&
+        ((uint64_t)__atomic_load_n(&g_mac_table.count, __ATOMIC_RELAXED) * 4 < (uint64_t)limit * 3 ||
+         limit >= g_mac_table.grow_limit)) {
+        return;
+    }
+    if (spinlock_try_acquire(&g_mac_table.resize_lock) != 0) {
+        return;
+    }
+
+    // Recheck under the lock; another thread may have moved on
+    layout = g_mac_table.layout;
+    buckets = (uint32_t)(layout >> 32) + 1;
+    index = 32 - (uint32_t)__builtin_clz(buckets >> g_mac_table.segment_bits);
+    if (index < MAC_SEGMENTS_MAX && g_mac_table.segments[index].buckets == NULL) {
+        if ((uint32_t)layout != 0 || limit >= g_mac_table.grow_limit || !mac_segment_alloc(index)) {
+            spinlock_release(&g_mac_table.resize_lock);
+            return;
+        }
+        LOG_INFO(LOG_CATEGORY_L2, "MAC table growing from %u to %u buckets", buckets, buckets * 2);
+    }
+
+    for (uint32_t i = 0; i < steps && index < MAC_SEGMENTS_MAX; i++) {
+        mac_table_split_bucket();
+        if ((uint32_t)g_mac_table.layout == 0) {
+            break;
+        }
+    }
+
+    uint32_t room = (uint32_t)((uint64_t)g_mac_table.size * 4 / 5);
+    if (room > g_mac_table.grow_limit) {
+        room = g_mac_table.grow_limit;
+    }
+    if (room > limit) {
+        __atomic_store_n(&g_mac_table.max_entries, room, __ATOMIC_RELAXED);
+    }
+    spinlock_release(&g_mac_table.resize_lock);
+}
+
+/**
+ * @brief Add or update a MAC entry in the table
+ *
+ * @param mac MAC address
+ * @param port_id Port ID
+ * @param vlan_id VLAN ID
+ * @param is_static Whether this is a static entry
+ * @return status_t Status code
+ */
+status_t mac_table_add(const mac_addr_t mac, port_id_t port_id, 
+                       vlan_id_t vlan_id, bool is_static) {
+    if (g_mac_table.segments[0].entries == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+    
+    // Frames received on a LAG member are learned on the LAG, decapsulated frames on their tunnel
+    if (!port_is_valid(port_id) && !lag_port_is_lag(port_id) && !vxlan_port_is_tunnel(port_id)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Invalid port ID: %u", port_id);
+        return STATUS_INVALID_PARAMETER;
+    }
+    
+    uint64_t key = mac_key(&mac, vlan_id);
+    uint64_t hash = mac_hash(key);
+    uint32_t now = __atomic_load_n(&g_mac_table.current_time, __ATOMIC_RELAXED);
+    mac_slot_t new_slot = {
+        .key = key,
+        .last_seen = now,
+        .port_id = port_id,
+        .is_static = is_static,
+    };
+    mac_entry_t new_entry = {
+        .expires = now + __atomic_load_n(&g_mac_table.aging_time, __ATOMIC_RELAXED) + 1,
+    };
+    uint32_t b1, b2;
+    mac_buckets(hash, &b1, &b2);
+
+    mac_table_lock_buckets(b1, b2);
+    
+    // Look for existing entry; it can only be in b1 or b2, both locked
+    int64_t slot = mac_table_find(key, hash);
+    if (slot >= 0) {
+        // Found existing entry, update it
+        const mac_slot_t *current = mac_slot((uint32_t)slot);
+        mac_entry_t *entry = mac_entry((uint32_t)slot);
+        
+        // If entry is being changed from dynamic to static
+        if (!current->is_static && is_static) {
+            __atomic_fetch_add(&g_mac_table.static_count, 1, __ATOMIC_RELAXED);
+        }
+        new_slot.is_static = current->is_static || is_static;
+        new_slot.hw_loc = current->hw_loc;
+        // Keep the queued aging item; it re-queues itself from last_seen
+        new_entry = *entry;
+        port_id_t old_port = current->port_id;
+        
+        // Dampen dynamic entries that keep moving between ports
+        bool frozen_now = false;
+        if (old_port != port_id && !new_slot.is_static &&
+            !mac_entry_note_move(&new_entry, entry, now, &frozen_now)) {
+            new_slot.port_id = old_port;
+            mac_slot_store((uint32_t)slot, &new_slot, &new_entry);
+            mac_table_unlock_buckets(b1, b2);
+            
+            if (frozen_now) {
+                mac_move_event_t event = {
+                    .mac_addr = mac,
+                    .vlan_id = vlan_id,
+                    .port_id = old_port,
+                    .moved_to = port_id,
+                    .timestamp = now,
+                    .frozen_until = new_entry.move_time,
+                };
+                mac_table_report_freeze(&event);
+            }
+            return STATUS_RESOURCE_BUSY;
+        }
+        
+        mac_slot_store((uint32_t)slot, &new_slot, &new_entry);
+        if (old_port != port_id) {
+            mac_index_unlink(MAC_INDEX_PORT, old_port, (uint32_t)slot);
+            mac_index_link(MAC_INDEX_PORT, port_id, (uint32_t)slot);
+            __atomic_add_fetch(&g_mac_table.generation, 1, __ATOMIC_RELEASE);
+        }
+        
+        mac_table_unlock_buckets(b1, b2);
+        if (old_port != port_id) {
+            TRACE_POINT(TRACE_MAC_MOVE, port_id, trace_mac_arg(&mac, vlan_id), old_port);
+            if (!new_slot.is_static) {
+                mac_table_notify(&mac, vlan_id, port_id, now, true);
+            }
+        }
+        LOG_DEBUG(LOG_CATEGORY_L2, "Updated MAC entry: %02x:%02x:%02x:%02x:%02x:%02x on port %u VLAN %u",
+                 mac.addr[0], mac.addr[1], mac.addr[2], mac.addr[3], mac.addr[4], mac.addr[5], port_id, vlan_id);
+        return STATUS_SUCCESS;
+    }
+    
+    // Reserve capacity
+    if (__atomic_add_fetch(&g_mac_table.count, 1, __ATOMIC_RELAXED) >
+        __atomic_load_n(&g_mac_table.max_entries, __ATOMIC_RELAXED)) {
+        __atomic_fetch_sub(&g_mac_table.count, 1, __ATOMIC_RELAXED);
+        mac_table_unlock_buckets(b1, b2);
+        mac_table_grow(MAC_GROW_STEP);
+        __atomic_fetch_add(&g_mac_table.learn_failures, 1, __ATOMIC_RELAXED);
+        LOG_ERROR(LOG_CATEGORY_L2, "MAC table is full");
+        return STATUS_TABLE_FULL;
+    }
+    
+    // Find room in the emulated hardware banks
+    if (!mac_hw_alloc(key, &new_slot.hw_loc)) {
+        __atomic_fetch_sub(&g_mac_table.count, 1, __ATOMIC_RELAXED);
+        mac_table_unlock_buckets(b1, b2);
+        __atomic_fetch_add(&g_mac_table.learn_failures, 1, __ATOMIC_RELAXED);
+        LOG_DEBUG(LOG_CATEGORY_L2, "MAC %02x:%02x:%02x:%02x:%02x:%02x VLAN %u not learned: hash banks full",
+                 mac.addr[0], mac.addr[1], mac.addr[2], mac.addr[3], mac.addr[4], mac.addr[5], vlan_id);
+        return STATUS_TABLE_FULL;
+    }
+    
+    bool stored = mac_table_insert_direct(hash, &new_slot, &new_entry);
+    mac_table_unlock_buckets(b1, b2);
+    
+    if (!stored) {
+        // Both buckets full: displacing keys touches other buckets, so
+        // take every stripe and check again for a racing insert
+        mac_table_lock_all();
+        if (mac_table_find(key, hash) >= 0) {
+            mac_table_unlock_all();
+            mac_hw_free(key, new_slot.hw_loc);
+            __atomic_fetch_sub(&g_mac_table.count, 1, __ATOMIC_RELAXED);
+            return mac_table_add(mac, port_id, vlan_id, is_static);
+        }
+        stored = mac_table_insert_path(hash, &new_slot, &new_entry);
+        mac_table_unlock_all();
+    }
+    
+    if (!stored) {
+        mac_hw_free(key, new_slot.hw_loc);
+        __atomic_fetch_sub(&g_mac_table.count, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&g_mac_table.learn_failures, 1, __ATOMIC_RELAXED);
+        LOG_ERROR(LOG_CATEGORY_L2, "MAC table is full: no free slot for new entry");
+        return STATUS_TABLE_FULL;
+    }
+    
+    if (is_static) {
+        __atomic_fetch_add(&g_mac_table.static_count, 1, __ATOMIC_RELAXED);
+    } else {
+        mac_wheel_insert(key, new_entry.expires);
+        mac_table_notify(&mac, vlan_id, port_id, now, true);
+    }
+    
+    mac_table_grow(MAC_GROW_STEP);
+    TRACE_POINT(TRACE_MAC_LEARN, port_id, trace_mac_arg(&mac, vlan_id), is_static);
+    LOG_DEBUG(LOG_CATEGORY_L2, "Added new MAC entry: %02x:%02x:%02x:%02x:%02x:%02x on port %u VLAN %u %s",
+             mac.addr[0], mac.addr[1], mac.addr[2], mac.addr[3], mac.addr[4], mac.addr[5], 
+             port_id, vlan_id, is_static ? "(static)" : "");
+             
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Clear a slot, keeping the counters in step
+ *
+ * @param slot Occupied slot index; the caller holds its stripe lock
+ */
+static inline void mac_table_clear_slot(uint32_t slot) {
+    const mac_slot_t *hot = mac_slot(slot);
+    
+    if (hot->is_static) {
+        __atomic_fetch_sub(&g_mac_table.static_count, 1, __ATOMIC_RELAXED);
+    }
+    mac_hw_free(hot->key, hot->hw_loc);
+    mac_index_remove(slot);
+    mac_slot_store(slot, NULL, NULL);
+    __atomic_fetch_sub(&g_mac_table.count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_mac_table.generation, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Remove a MAC entry from the table
+ *
+ * @param mac MAC address
+ * @param vlan_id VLAN ID
+ * @return status_t Status code
+ */
+status_t mac_table_remove(const mac_addr_t mac, vlan_id_t vlan_id) {
+    if (g_mac_table.segments[0].entries == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+    
+    uint64_t key = mac_key(&mac, vlan_id);
+    uint64_t hash = mac_hash(key);
+
+    uint32_t b1, b2;
+    mac_buckets(hash, &b1, &b2);
+
+    mac_table_lock_buckets(b1, b2);
+    
+    int64_t slot = mac_table_find(key, hash);
+    if (slot >= 0) {
+        // Found the entry, remove it
+        port_id_t port_id = mac_slot((uint32_t)slot)->port_id;
+        mac_table_clear_slot((uint32_t)slot);
+        
+        mac_table_unlock_buckets(b1, b2);
+        
+        TRACE_POINT(TRACE_MAC_REMOVE, port_id, trace_mac_arg(&mac, vlan_id), 0);
+        LOG_DEBUG(LOG_CATEGORY_L2, "Removed MAC entry: %02x:%02x:%02x:%02x:%02x:%02x VLAN %u",
+                 mac.addr[0], mac.addr[1], mac.addr[2], mac.addr[3], mac.addr[4], mac.addr[5], vlan_id);
+        return STATUS_SUCCESS;
+    }
+    
+    mac_table_unlock_buckets(b1, b2);
+    
+    LOG_DEBUG(LOG_CATEGORY_L2, "MAC entry not found for removal: %02x:%02x:%02x:%02x:%02x:%02x VLAN %u",
+             mac.addr[0], mac.addr[1], mac.addr[2], mac.addr[3], mac.addr[4], mac.addr[5], vlan_id);
+    return STATUS_NOT_FOUND;
+}
+
+/**
+ * @brief Hit bitmap of the calling thread in the current instance
+ */
+static inline uint64_t *mac_hit_map(void) {
+    if (__builtin_expect(t_mac_hit_map == UINT32_MAX, 0)) {
+        t_mac_hit_map = __atomic_fetch_add(&g_mac_hit_next, 1, __ATOMIC_RELAXED) % MAC_HIT_MAPS;
+    }
+    return &g_mac_table.hit_maps[(size_t)t_mac_hit_map * g_mac_table.hit_words];
+}
+
+/**
+ * @brief Read the port of a key without locking, marking it hit
+ *
+ * @param key Packed key
+ * @param hash Key hash
+ * @param hits Hit bitmap of the calling thread
+ * @param port_id Receives the port if found
+ * @return bool true if found
+ */
+static bool mac_table_read(uint64_t key, uint64_t hash, uint64_t *hits, port_id_t *port_id) {
+    uint32_t b1, b2;
+    mac_buckets(hash, &b1, &b2);
+    mac_stripe_t *s1 = mac_stripe(b1);
+    mac_stripe_t *s2 = mac_stripe(b2);
+    int64_t slot;
+    port_id_t found_port = PORT_ID_INVALID;
+
+    // Retry while a writer is changing either bucket
+    for (;;) {
+        uint32_t seq1 = __atomic_load_n(&s1->seq, __ATOMIC_ACQUIRE);
+        uint32_t seq2 = __atomic_load_n(&s2->seq, __ATOMIC_ACQUIRE);
+        if ((seq1 | seq2) & 1) {
+            continue;
+        }
+
+        slot = mac_table_find(key, hash);
+        if (slot >= 0) {
+            found_port = mac_slot((uint32_t)slot)->port_id;
+            // Check before writing, so the word stays shared while the
+            // bit is set; a bit set for an entry a racing writer moved
+            // only keeps the slot's new entry one tick longer
+            uint64_t *word = &hits[(uint64_t)slot >> 6];
+            uint64_t bit = 1ULL << ((uint64_t)slot & 63);
+            if (!(__atomic_load_n(word, __ATOMIC_RELAXED) & bit)) {
+                __atomic_fetch_or(word, bit, __ATOMIC_RELAXED);
+            }
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s1->seq, __ATOMIC_RELAXED) == seq1 &&
+            __atomic_load_n(&s2->seq, __ATOMIC_RELAXED) == seq2) {
+            break;
+        }
+    }
+
+    *port_id = found_port;
+    return slot >= 0;
+}
+
+/**
+ * @brief Look up a MAC address in the table
+ *
+ * @param mac MAC address to look up
+ * @param vlan_id VLAN ID
+ * @param port_id Pointer to store the port ID if found
+ * @return status_t Status code
+ */
+status_t mac_table_lookup(const mac_addr_t mac, vlan_id_t vlan_id, 
+                         port_id_t *port_id) {
+    if (g_mac_table.segments[0].entries == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+    
+    if (port_id == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "NULL port_id pointer");
+        return STATUS_INVALID_PARAMETER;
+    }
+    
+    uint64_t key = mac_key(&mac, vlan_id);
+    uint64_t hash = mac_hash(key);
+    if (mac_table_read(key, hash, mac_hit_map(), port_id)) {
+        LOG_DEBUG(LOG_CATEGORY_L2, "MAC lookup found: %02x:%02x:%02x:%02x:%02x:%02x VLAN %u -> port %u",
+                 mac.addr[0], mac.addr[1], mac.addr[2], mac.addr[3], mac.addr[4], mac.addr[5], vlan_id, *port_id);
+        return STATUS_SUCCESS;
+    }
+    
+    LOG_DEBUG(LOG_CATEGORY_L2, "MAC lookup not found: %02x:%02x:%02x:%02x:%02x:%02x VLAN %u",
+             mac.addr[0], mac.addr[1], mac.addr[2], mac.addr[3], mac.addr[4], mac.addr[5], vlan_id);
+    return STATUS_NOT_FOUND;
+}
+
+/**
+ * @brief Look up a burst of MAC addresses
+ *
+ * All keys are hashed and their buckets prefetched before the first probe,
+ * so the cache misses of the burst overlap instead of running back to back.
+ *
+ * @param macs MAC addresses
+ * @param vlans VLAN ID of each address
+ * @param n Number of addresses (at most MAC_TABLE_BULK_MAX)
+ * @param ports Receives the port of each address found
+ * @param hit_mask Receives bit i set if macs[i] was found
+ * @return status_t Status code
+ */
+status_t mac_table_lookup_bulk(const mac_addr_t *macs, const vlan_id_t *vlans, uint32_t n,
+                               port_id_t *ports, uint64_t *hit_mask) {
+    uint64_t keys[MAC_TABLE_BULK_MAX];
+    uint64_t hashes[MAC_TABLE_BULK_MAX];
+
+    if (g_mac_table.segments[0].entries == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (macs == NULL || vlans == NULL || ports == NULL || hit_mask == NULL || n > MAC_TABLE_BULK_MAX) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Invalid bulk lookup parameters");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // Pass 1: hash every key and start loading both of its buckets
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t b1, b2;
+        keys[i] = mac_key(&macs[i], vlans[i]);
+        hashes[i] = mac_hash(keys[i]);
+        mac_buckets(hashes[i], &b1, &b2);
+        __builtin_prefetch(mac_bucket(b1));
+        __builtin_prefetch(mac_bucket(b2));
+    }
+
+    // Pass 2: resolve against the now cached buckets
+    uint64_t *hit_map = mac_hit_map();
+    uint64_t hits = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (mac_table_read(keys[i], hashes[i], hit_map, &ports[i])) {
+            hits |= 1ULL << i;
+        }
+    }
+
+    *hit_mask = hits;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Check an entry against flush criteria
+ */
+static inline bool mac_flush_match(const mac_slot_t *entry, vlan_id_t vlan_id,
+                                   port_id_t port_id, bool flush_static) {
+    if (vlan_id != 0 && mac_key_vlan(entry->key) != vlan_id) {
+        return false;
+    }
+    
+    if (port_id != PORT_ID_INVALID && entry->port_id != port_id) {
+        return false;
+    }
+    
+    if (!flush_static && entry->is_static) {
+        return false;
+    }
+    
+    return true;
+}
+
+/**
+ * @brief Flush by walking one port or VLAN list
+ *
+ * The keys on the list are copied under the list lock, then each entry is
+ * re-checked and cleared under its stripe locks, keeping the stripe-then-
+ * list lock order.
+ *
+ * @param index MAC_INDEX_PORT or MAC_INDEX_VLAN
+ * @param id Port or VLAN ID of the list
+ * @param flushed Receives the number of entries removed
+ * @return bool false if the key copy could not be allocated
+ */
+static bool mac_table_flush_indexed(int index, uint32_t id, vlan_id_t vlan_id, port_id_t port_id,
+                                    bool flush_static, uint32_t *flushed) {
+    mac_index_list_t *list = mac_index_list(index, id);
+    uint64_t *keys = NULL;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+    bool ok = true;
+
+    spinlock_acquire(&list->lock);
+    for (uint32_t slot = list->head; slot != MAC_SLOT_NONE; slot = mac_links(slot)->link[index].next) {
+        if (count == capacity) {
+            uint32_t grown = capacity ? capacity * 2 : 64;
+            uint64_t *tmp = (uint64_t *)mem_realloc(MEM_TAG_MAC_TABLE, keys, grown * sizeof(uint64_t));
+            if (tmp == NULL) {
+                ok = false;
+                break;
+            }
+            keys = tmp;
+            capacity = grown;
+        }
+        keys[count++] = *mac_slot_key(slot);
+    }
+    spinlock_release(&list->lock);
+
+    *flushed = 0;
+    for (uint32_t i = 0; ok && i < count; i++) {
+        uint64_t hash = mac_hash(keys[i]);
+        uint32_t b1, b2;
+        mac_buckets(hash, &b1, &b2);
+
+        mac_table_lock_buckets(b1, b2);
+        int64_t slot = mac_table_find(keys[i], hash);
+        if (slot >= 0 && mac_flush_match(mac_slot((uint32_t)slot), vlan_id, port_id, flush_static)) {
+            mac_table_clear_slot((uint32_t)slot);
+            (*flushed)++;
+        }
+        mac_table_unlock_buckets(b1, b2);
+    }
+
+    mem_free(MEM_TAG_MAC_TABLE, keys);
+    return ok;
+}
+
+/**
+ * @brief Flush all entries from the MAC table
+ *
+ * Flushing a port or a VLAN only visits the entries of that port or VLAN.
+ *
+ * @param vlan_id VLAN ID to flush (0 for all VLANs)
+ * @param port_id Port ID to flush (PORT_ID_INVALID for all ports)
+ * @param flush_static Whether to flush static entries too
+ * @return status_t Status code
+ */
+status_t mac_table_flush(vlan_id_t vlan_id, port_id_t port_id, bool flush_static) {
+    if (g_mac_table.segments[0].entries == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+    
+    uint32_t flushed = 0;
+    
+    if (port_id != PORT_ID_INVALID &&
+        mac_table_flush_indexed(MAC_INDEX_PORT, port_id, vlan_id, port_id, flush_static, &flushed)) {
+        LOG_INFO(LOG_CATEGORY_L2, "Flushed %u MAC table entries", flushed);
+        return STATUS_SUCCESS;
+    }
+    
+    if (port_id == PORT_ID_INVALID && vlan_id != 0 &&
+        mac_table_flush_indexed(MAC_INDEX_VLAN, vlan_id, vlan_id, port_id, flush_static, &flushed)) {
+        LOG_INFO(LOG_CATEGORY_L2, "Flushed %u MAC table entries", flushed);
+        return STATUS_SUCCESS;
+    }
+    
+    // Iterate through all occupied slots, locking one bucket at a time
+    for (uint32_t bucket = 0; bucket < mac_bucket_count(); bucket++) {
+        mac_table_lock_buckets(bucket, bucket);
+        
+        for (uint32_t i = bucket * MAC_BUCKET_SLOTS; i < (bucket + 1) * MAC_BUCKET_SLOTS; i++) {
+            if (*mac_slot_key(i) != 0 && mac_flush_match(mac_slot(i), vlan_id, port_id, flush_static)) {
+                mac_table_clear_slot(i);
+                flushed++;
+            }
+        }
+        
+        mac_table_unlock_buckets(bucket, bucket);
+    }
+    
+    LOG_INFO(LOG_CATEGORY_L2, "Flushed %u MAC table entries", flushed);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Handle a due aging wheel item
+ *
+ * @param item Due item
+ * @param now Current time in seconds
+ * @param aging_time Aging time in seconds
+ * @return bool true if the entry was aged out
+ */
+static bool mac_table_age_item(const mac_wheel_item_t *item, uint32_t now, uint32_t aging_time) {
+    uint64_t hash = mac_hash(item->key);
+    uint32_t b1, b2;
+    mac_buckets(hash, &b1, &b2);
+
+    mac_table_lock_buckets(b1, b2);
+
+    // Skip stale items: entry gone, made static or queued again since
+    int64_t slot = mac_table_find(item->key, hash);
+    mac_slot_t *hot = slot >= 0 ? mac_slot((uint32_t)slot) : NULL;
+    mac_entry_t *entry = slot >= 0 ? mac_entry((uint32_t)slot) : NULL;
+    if (entry == NULL || hot->is_static || entry->expires != item->deadline) {
+        mac_table_unlock_buckets(b1, b2);
+        return false;
+    }
+
+    uint32_t last_seen = __atomic_load_n(&hot->last_seen, __ATOMIC_RELAXED);
+    if (now - last_seen <= aging_time) {
+        // Seen since it was queued: wait out the rest of its aging time
+        entry->expires = last_seen + aging_time + 1;
+        mac_wheel_insert(item->key, entry->expires);
+        mac_table_unlock_buckets(b1, b2);
+        return false;
+    }
+
+    mac_addr_t mac;
+    vlan_id_t vlan;
+    mac_key_unpack(item->key, &mac, &vlan);
+
+    LOG_DEBUG(LOG_CATEGORY_L2, "Aged out MAC entry: %02x:%02x:%02x:%02x:%02x:%02x VLAN %u Port %u",
+             mac.addr[0], mac.addr[1], mac.addr[2], mac.addr[3], mac.addr[4], mac.addr[5],
+             vlan, hot->port_id);
+    TRACE_POINT(TRACE_MAC_REMOVE, hot->port_id, trace_mac_arg(&mac, vlan), 1);
+
+    port_id_t port_id = hot->port_id;
+    mac_table_clear_slot((uint32_t)slot);
+    mac_table_unlock_buckets(b1, b2);
+    mac_table_notify(&mac, vlan, port_id, now, false);
+    return true;
+}
+
+/**
+ * @brief Move every item of a wheel slot into another slot, emptying it
+ */
+static bool mac_wheel_slot_take(mac_wheel_slot_t *to, mac_wheel_slot_t *from) {
+    for (uint32_t i = 0; i < from->count; i++) {
+        if (!mac_wheel_slot_push(to, from->items[i].key, from->items[i].deadline)) {
+            return false;
+        }
+    }
+    from->count = 0;
+    return true;
+}
+
+/**
+ * @brief Advance the wheel by one second and detach the items due then
+ *
+ * @param wheel Aging wheel
+ * @param due Receives the due items
+ * @param now Current time; the wheel does not advance past it
+ * @return bool false if the wheel is already at now
+ */
+static bool mac_wheel_advance(mac_wheel_t *wheel, mac_wheel_slot_t *due, uint32_t now) {
+    spinlock_acquire(&wheel->lock);
+
+    if ((int32_t)(now - wheel->time) <= 0) {
+        spinlock_release(&wheel->lock);
+        return false;
+    }
+
+    uint32_t span = MAC_WHEEL_L0_SLOTS * MAC_WHEEL_L1_SLOTS;
+    if (now - wheel->time >= span) {
+        // Too far behind to step; everything queued is re-examined
+        for (uint32_t i = 0; i < MAC_WHEEL_L0_SLOTS; i++) {
+            mac_wheel_slot_take(due, &wheel->level0[i]);
+        }
+        for (uint32_t i = 0; i < MAC_WHEEL_L1_SLOTS; i++) {
+            mac_wheel_slot_take(due, &wheel->level1[i]);
+        }
+        wheel->time = now;
+        spinlock_release(&wheel->lock);
+        return true;
+    }
+
+    uint32_t t = ++wheel->time;
+    mac_wheel_slot_t *slot = &wheel->level0[t & (MAC_WHEEL_L0_SLOTS - 1)];
+
+    // Start of a level 0 turn: file the next level 1 slot's items
+    if ((t & (MAC_WHEEL_L0_SLOTS - 1)) == 0) {
+        mac_wheel_slot_t *upper = &wheel->level1[(t >> MAC_WHEEL_L0_BITS) & (MAC_WHEEL_L1_SLOTS - 1)];
+        for (uint32_t i = 0; i < upper->count; i++) {
+            if ((int32_t)(upper->items[i].deadline - t) <= 0) {
+                mac_wheel_slot_push(slot, upper->items[i].key, upper->items[i].deadline);
+            } else {
+                mac_wheel_insert_locked(wheel, upper->items[i].key, upper->items[i].deadline);
+            }
+        }
+        upper->count = 0;
+    }
+
+    // Hand the slot's array over instead of copying it
+    *due = *slot;
+    memset(slot, 0, sizeof(*slot));
+
+    spinlock_release(&wheel->lock);
+    return true;
+}
+
+/**
+ * @brief Take the bits out of every hit bitmap and mark the entries hit
+ *
+ * @param table Table
+ * @param seen Time the hits are credited to, that of the previous tick
+ */
+static void mac_table_harvest_hits(mac_table_internal_t *table, uint32_t seen) {
+    uint32_t size = __atomic_load_n(&table->size, __ATOMIC_ACQUIRE);
+
+    for (uint32_t w = 0; w < table->hit_words && (uint64_t)w * 64 < size; w++) {
+        uint64_t bits = 0;
+
+        for (uint32_t m = 0; m < MAC_HIT_MAPS; m++) {
+            uint64_t *word = &table->hit_maps[(size_t)m * table->hit_words + w];
+            if (__atomic_load_n(word, __ATOMIC_RELAXED) != 0) {
+                bits |= __atomic_exchange_n(word, 0, __ATOMIC_RELAXED);
+            }
+        }
+
+        while (bits != 0) {
+            uint32_t slot = w * 64 + (uint32_t)__builtin_ctzll(bits);
+            uint32_t bucket = slot / MAC_BUCKET_SLOTS;
+            uint32_t first;
+            mac_segment_t *segment = mac_segment(table, bucket, &first);
+            mac_slot_t *hot = &segment->buckets[bucket - first].slots[slot % MAC_BUCKET_SLOTS];
+            mac_stripe_t *stripe = &table->stripes[bucket & (MAC_TABLE_STRIPES - 1)];
+
+            bits &= bits - 1;
+            // The stripe lock keeps the store off a slot being rewritten
+            spinlock_acquire(&stripe->lock);
+            if (hot->key != 0 && !hot->is_static && (int32_t)(seen - hot->last_seen) > 0) {
+                __atomic_store_n(&hot->last_seen, seen, __ATOMIC_RELAXED);
+            }
+            spinlock_release(&stripe->lock);
+        }
+    }
+}
+
+/**
+ * @brief Process aging of MAC table entries
+ *
+ * Removes entries that have exceeded the aging time threshold.
+ * This function should be called periodically by the system. Only the
+ * aging wheel slots between the previous call and current_time are
+ * visited, so the cost follows the number of entries coming due rather
+ * than the table size, plus one pass over the hit bitmaps' words.
+ *
+ * @param table Pointer to the MAC table instance
+ * @param current_time Current system time in seconds
+ * @return status_t Status code
+ */
+status_t mac_table_process_aging(mac_table_t *table, uint32_t current_time) {
+    mac_table_internal_t *internal_table = (mac_table_internal_t *)table;
+    
+    if (internal_table == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "NULL MAC table pointer");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (internal_table->segments[0].entries == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    // Credit the hits since the last tick to its time, then move on
+    mac_table_harvest_hits(internal_table,
+                           __atomic_load_n(&internal_table->current_time, __ATOMIC_RELAXED));
+    __atomic_store_n(&internal_table->current_time, current_time, __ATOMIC_RELAXED);
+    mac_table_grow(MAC_GROW_TICK_STEP);
+
+    uint32_t aging_time = __atomic_load_n(&internal_table->aging_time, __ATOMIC_RELAXED);
+    uint32_t aged_out = 0;
+    mac_wheel_slot_t due = { 0 };
+
+    while (mac_wheel_advance(&internal_table->wheel, &due, current_time)) {
+        for (uint32_t i = 0; i < due.count; i++) {
+            if (mac_table_age_item(&due.items[i], current_time, aging_time)) {
+                aged_out++;
+            }
+        }
+        mem_free(MEM_TAG_MAC_TABLE, due.items);
+        memset(&due, 0, sizeof(due));
+    }
+
+    if (aged_out > 0) {
+        LOG_DEBUG(LOG_CATEGORY_L2, "Aged out %u MAC table entries", aged_out);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get MAC table statistics
+ *
+ * @param stats Pointer to statistics structure to fill
+ * @return status_t Status code
+ */
+status_t mac_table_get_stats(mac_table_stats_t *stats) {
+    if (g_mac_table.segments[0].entries == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+    
+    if (stats == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "NULL stats pointer");
+        return STATUS_INVALID_PARAMETER;
+    }
+    
+    // Fill statistics from the atomic counters
+    uint32_t count = __atomic_load_n(&g_mac_table.count, __ATOMIC_RELAXED);
+    uint32_t static_count = __atomic_load_n(&g_mac_table.static_count, __ATOMIC_RELAXED);
+    
+    stats->total_entries = count;
+    stats->static_entries = static_count;
+    stats->dynamic_entries = count > static_count ? count - static_count : 0;
+    stats->table_size = __atomic_load_n(&g_mac_table.size, __ATOMIC_RELAXED);
+    stats->aging_time = __atomic_load_n(&g_mac_table.aging_time, __ATOMIC_RELAXED);
+    stats->learn_failures = __atomic_load_n(&g_mac_table.learn_failures, __ATOMIC_RELAXED);
+    
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the MAC table generation
+ *
+ * The counter moves on whenever an entry moves to another port or is
+ * removed, so forwarding state derived from the table is current while
+ * it has not moved.
+ *
+ * @return uint32_t Current generation
+ */
+uint32_t mac_table_get_generation(void) {
+    return __atomic_load_n(&g_mac_table.generation, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Number of entries the table can hold
+ *
+ * The entry limit, or the emulated banks' capacity if that is lower.
+ */
+static uint32_t mac_table_capacity(void) {
+    const mac_table_hw_profile_t *profile = &g_mac_table.hw.profile;
+    uint32_t capacity = __atomic_load_n(&g_mac_table.max_entries, __ATOMIC_RELAXED);
+
+    if (profile->mode == MAC_TABLE_MODE_BANKED) {
+        uint64_t banked = (uint64_t)profile->banks * (profile->rows * (uint64_t)profile->ways + profile->overflow);
+        if (banked < capacity) {
+            capacity = (uint32_t)banked;
+        }
+    }
+    return capacity;
+}
+
+/**
+ * @brief Check if MAC table has sufficient resources for new entries
+ *
+ * In banked mode this is an upper bound: hash collisions can refuse a
+ * key before the banks are full.
+ *
+ * @param count Number of entries to check
+ * @param available Output parameter set to true if resources are available
+ * @return status_t Status code
+ */
+status_t mac_table_check_resources(uint32_t count, bool *available) {
+    if (g_mac_table.segments[0].entries == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+    
+    if (available == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "NULL available pointer");
+        return STATUS_INVALID_PARAMETER;
+    }
+    
+    uint32_t used = __atomic_load_n(&g_mac_table.count, __ATOMIC_RELAXED);
+    *available = (uint64_t)used + count <= mac_table_capacity();
+    
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get MAC table resource usage
+ *
+ * @param usage Output parameter to store usage information
+ * @return status_t Status code
+ */
+status_t mac_table_get_resource_usage(hw_resource_usage_t *usage) {
+    if (g_mac_table.segments[0].entries == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+    
+    if (usage == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "NULL usage pointer");
+        return STATUS_INVALID_PARAMETER;
+    }
+    
+    uint32_t used = __atomic_load_n(&g_mac_table.count, __ATOMIC_RELAXED);
+    
+    usage->total = mac_table_capacity();
+    usage->used = used;
+    usage->reserved = 0;
+    usage->available = usage->total > used ? usage->total - used : 0;
+    
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Select the hardware hash layout new entries are placed in
+ *
+ * @param profile Layout to emulate
+ * @return status_t Status code
+ */
+status_t mac_table_set_hw_profile(const mac_table_hw_profile_t *profile) {
+    if (g_mac_table.segments[0].entries == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+    
+    if (profile == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "NULL hardware profile");
+        return STATUS_INVALID_PARAMETER;
+    }
+    
+    if (profile->mode == MAC_TABLE_MODE_BANKED &&
+        (profile->banks == 0 || profile->banks > MAC_TABLE_HW_MAX_BANKS || profile->rows == 0 ||
+         profile->ways == 0 || profile->ways > MAC_TABLE_HW_MAX_WAYS)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Invalid MAC table hardware profile: %u banks x %u rows x %u ways",
+                 profile->banks, profile->rows, profile->ways);
+        return STATUS_INVALID_PARAMETER;
+    }
+    
+    mac_hw_bank_t banks[MAC_TABLE_HW_MAX_BANKS];
+    memset(banks, 0, sizeof(banks));
+    if (profile->mode == MAC_TABLE_MODE_BANKED) {
+        for (uint32_t b = 0; b < profile->banks; b++) {
+            banks[b].rows = (uint8_t *)mem_calloc(MEM_TAG_MAC_TABLE, profile->rows, sizeof(uint8_t));
+            if (banks[b].rows == NULL) {
+                for (uint32_t i = 0; i < b; i++) {
+                    mem_free(MEM_TAG_MAC_TABLE, banks[i].rows);
+                }
+                LOG_ERROR(LOG_CATEGORY_L2, "Failed to allocate MAC table hash banks");
+                return STATUS_NO_MEMORY;
+            }
+        }
+    }
+    
+    // Holding every stripe keeps adds out while the layout changes
+    mac_table_lock_all();
+    if (__atomic_load_n(&g_mac_table.count, __ATOMIC_RELAXED) != 0) {
+        mac_table_unlock_all();
+        for (uint32_t b = 0; b < MAC_TABLE_HW_MAX_BANKS; b++) {
+            mem_free(MEM_TAG_MAC_TABLE, banks[b].rows);
+        }
+        LOG_ERROR(LOG_CATEGORY_L2, "MAC table hardware profile can only change while the table is empty");
+        return STATUS_RESOURCE_BUSY;
+    }
+    
+    spinlock_acquire(&g_mac_table.hw.lock);
+    mac_hw_free_banks();
+    if (profile->mode == MAC_TABLE_MODE_BANKED) {
+        memcpy(g_mac_table.hw.banks, banks, sizeof(banks));
+        g_mac_table.hw.profile = *profile;
+    }
+    spinlock_release(&g_mac_table.hw.lock);
+    mac_table_unlock_all();
+    
+    if (profile->mode == MAC_TABLE_MODE_BANKED) {
+        LOG_INFO(LOG_CATEGORY_L2, "MAC table emulating %u hash banks x %u rows x %u ways, %u overflow entries per bank",
+                profile->banks, profile->rows, profile->ways, profile->overflow);
+    }
+    
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the occupancy of each emulated hash bank
+ *
+ * @param stats Array to store per-bank statistics
+ * @param max_banks Size of the stats array
+ * @param count Output parameter to store number of banks returned
+ * @return status_t Status code
+ */
+status_t mac_table_get_hw_bank_stats(mac_table_hw_bank_stats_t *stats, uint32_t max_banks,
+                                     uint32_t *count) {
+    if ((stats == NULL && max_banks > 0) || count == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "NULL bank stats pointer");
+        return STATUS_INVALID_PARAMETER;
+    }
+    
+    mac_hw_model_t *hw = &g_mac_table.hw;
+    uint32_t n = 0;
+    
+    spinlock_acquire(&hw->lock);
+    if (hw->profile.mode == MAC_TABLE_MODE_BANKED) {
+        n = hw->profile.banks < max_banks ? hw->profile.banks : max_banks;
+    }
+    for (uint32_t b = 0; b < n; b++) {
+        stats[b].capacity = hw->profile.rows * hw->profile.ways;
+        stats[b].used = hw->banks[b].used;
+        stats[b].overflow_capacity = hw->profile.overflow;
+        stats[b].overflow_used = hw->banks[b].overflow_used;
+        stats[b].full_rows = hw->banks[b].full_rows;
+        stats[b].row_collisions = hw->banks[b].row_collisions;
+    }
+    spinlock_release(&hw->lock);
+    
+    *count = n;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Set MAC table aging time
+ *
+ * @param aging_time New aging time in seconds
  * @return status_t Status code
  */
-status_t mac_table_add(const mac_addr_t mac, port_id_t port_id, 
-                       vlan_id_t vlan_id, bool is_static) {
-    if (g_mac_table.entries == NULL) {
+status_t mac_table_set_aging_time(uint32_t aging_time) {
+    if (g_mac_table.segments[0].entries == NULL) {
         LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
         return STATUS_NOT_INITIALIZED;
     }
     
-    if (!port_is_valid(port_id)) {
-        LOG_ERROR(LOG_CATEGORY_L2, "Invalid port ID: %u", port_id);
+    if (aging_time == 0) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Invalid aging time: %u", aging_time);
         return STATUS_INVALID_PARAMETER;
     }
     
-    mac_table_acquire_lock();
+    // Re-queue every dynamic entry against the new aging time; queued
+    // deadlines would otherwise hold a shortened aging time back
+    mac_table_lock_all();
+    __atomic_store_n(&g_mac_table.aging_time, aging_time, __ATOMIC_RELAXED);
     
-    // Check if we've reached maximum capacity
-    if (g_mac_table.count >= MAC_TABLE_MAX_ENTRIES) {
-        mac_table_release_lock();
-        LOG_ERROR(LOG_CATEGORY_L2, "MAC table is full");
-        return STATUS_TABLE_FULL;
+    spinlock_acquire(&g_mac_table.wheel.lock);
+    for (uint32_t i = 0; i < MAC_WHEEL_L0_SLOTS; i++) {
+        g_mac_table.wheel.level0[i].count = 0;
+    }
+    for (uint32_t i = 0; i < MAC_WHEEL_L1_SLOTS; i++) {
+        g_mac_table.wheel.level1[i].count = 0;
+    }
+    for (uint32_t i = 0; i < g_mac_table.size; i++) {
+        const mac_slot_t *hot = mac_slot(i);
+        mac_entry_t *entry = mac_entry(i);
+        if (hot->key == 0 || hot->is_static) {
+            continue;
+        }
+        entry->expires = hot->last_seen + aging_time + 1;
+        mac_wheel_insert_locked(&g_mac_table.wheel, hot->key, entry->expires);
     }
+    spinlock_release(&g_mac_table.wheel.lock);
     
-    uint32_t hash = mac_hash(&mac, vlan_id);
-    mac_entry_t *entry = g_mac_table.entries[hash];
-    mac_entry_t *prev = NULL;
+    mac_table_unlock_all();
     
-    // Look for existing entry
-    while (entry != NULL) {
-        if (memcmp(&entry->mac_addr, &mac, MAC_ADDR_LEN) == 0 && 
-            entry->vlan_id == vlan_id) {
-            // Found existing entry, update it
-            entry->port_id = port_id;
-            entry->last_seen = g_mac_table.current_time;
-            
-            // If entry is being changed from dynamic to static
-            if (!entry->is_static && is_static) {
-                entry->is_static = true;
+    LOG_INFO(LOG_CATEGORY_L2, "MAC table aging time set to %u seconds", aging_time);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Fill iteration info for an occupied slot
+ */
+static inline void mac_entry_info_fill(mac_table_entry_t *info, uint64_t key, const mac_slot_t *entry) {
+    memset(info, 0, sizeof(*info));
+    mac_key_unpack(key, &info->mac_addr, &info->vlan_id);
+    info->port_id = entry->port_id;
+    info->type = entry->is_static ? MAC_ENTRY_TYPE_STATIC : MAC_ENTRY_TYPE_DYNAMIC;
+    info->aging = entry->is_static ? MAC_AGING_DISABLED : MAC_AGING_ACTIVE;
+    info->age_timestamp = entry->last_seen;
+}
+
+/**
+ * @brief Copy the occupied slots of a bucket without locking
+ *
+ * @param bucket Bucket index
+ * @param info Receives up to MAC_BUCKET_SLOTS entries
+ * @return uint32_t Number of entries copied
+ */
+static uint32_t mac_bucket_read(uint32_t bucket, mac_table_entry_t *info) {
+    mac_stripe_t *stripe = mac_stripe(bucket);
+    uint32_t n;
+
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&stripe->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            continue;
+        }
+
+        n = 0;
+        for (uint32_t i = bucket * MAC_BUCKET_SLOTS; i < (bucket + 1) * MAC_BUCKET_SLOTS; i++) {
+            uint64_t key = __atomic_load_n(mac_slot_key(i), __ATOMIC_RELAXED);
+            if (key != 0) {
+                mac_entry_info_fill(&info[n++], key, mac_slot(i));
             }
-            
-            mac_table_release_lock();
-            LOG_DEBUG(LOG_CATEGORY_L2, "Updated MAC entry: %02x:%02x:%02x:%02x:%02x:%02x on port %u VLAN %u",
-                     mac.addr[0], mac.addr[1], mac.addr[2], mac.addr[3], mac.addr[4], mac.addr[5], port_id, vlan_id);
-            return STATUS_SUCCESS;
         }
-        prev = entry;
-        entry = entry->next;
-    }
-    
-    // Create new entry
-    mac_entry_t *new_entry = (mac_entry_t*)malloc(sizeof(mac_entry_t));
-    if (new_entry == NULL) {
-        mac_table_release_lock();
-        LOG_ERROR(LOG_CATEGORY_L2, "Failed to allocate memory for MAC entry");
-        return STATUS_NO_MEMORY;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&stripe->seq, __ATOMIC_RELAXED) == seq) {
+            return n;
+        }
     }
-    
-    // Initialize the new entry
-    memcpy(new_entry->mac_addr.addr, mac.addr, MAC_ADDR_LEN);
-    new_entry->port_id = port_id;
-    new_entry->vlan_id = vlan_id;
-    new_entry->last_seen = g_mac_table.current_time;
-    new_entry->is_static = is_static;
-    new_entry->next = NULL;
-    
-    // Add to hash table
-    if (prev == NULL) {
-        g_mac_table.entries[hash] = new_entry;
-    } else {
-        prev->next = new_entry;
+}
+
+/**
+ * @brief Order entries by MAC address, then VLAN
+ */
+static int mac_entry_info_compare(const void *a, const void *b) {
+    const mac_table_entry_t *x = (const mac_table_entry_t *)a;
+    const mac_table_entry_t *y = (const mac_table_entry_t *)b;
+    int diff = memcmp(x->mac_addr.addr, y->mac_addr.addr, MAC_ADDR_LEN);
+
+    if (diff != 0) {
+        return diff;
     }
-    
-    g_mac_table.count++;
-    
-    mac_table_release_lock();
-    
-    LOG_DEBUG(LOG_CATEGORY_L2, "Added new MAC entry: %02x:%02x:%02x:%02x:%02x:%02x on port %u VLAN %u %s",
-             mac.addr[0], mac.addr[1], mac.addr[2], mac.addr[3], mac.addr[4], mac.addr[5], 
-             port_id, vlan_id, is_static ? "(static)" : "");
-             
-    return STATUS_SUCCESS;
+    return (int)x->vlan_id - (int)y->vlan_id;
 }
 
 /**
- * @brief Remove a MAC entry from the table
+ * @brief Copy every entry of the table, sorted by MAC address and VLAN
  *
- * @param mac MAC address
- * @param vlan_id VLAN ID
- * @return status_t Status code
+ * Buckets are read lock-free and the pass is repeated if a displacement
+ * walk ran meanwhile; after MAC_SNAPSHOT_RETRIES passes the copy is made
+ * under all stripe locks. A key removed and re-added in its other bucket
+ * during the pass can be read twice, so the copy is sorted and duplicates
+ * are dropped.
+ *
+ * @param out Output array
+ * @param max Size of the output array
+ * @param total Receives the number of entries in the table, which may
+ *              exceed max
  */
-status_t mac_table_remove(const mac_addr_t mac, vlan_id_t vlan_id) {
-    if (g_mac_table.entries == NULL) {
-        LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
-        return STATUS_NOT_INITIALIZED;
+static void mac_table_copy_entries(mac_table_entry_t *out, uint32_t max, uint32_t *total) {
+    mac_table_entry_t info[MAC_BUCKET_SLOTS];
+    uint32_t n = 0;
+
+    for (int attempt = 0; attempt <= MAC_SNAPSHOT_RETRIES; attempt++) {
+        bool locked = attempt == MAC_SNAPSHOT_RETRIES;
+        uint32_t seq = 0;
+
+        if (locked) {
+            mac_table_lock_all();
+        } else {
+            seq = __atomic_load_n(&g_mac_table.displace_seq, __ATOMIC_ACQUIRE);
+            if (seq & 1) {
+                continue;
+            }
+        }
+
+        n = 0;
+        for (uint32_t bucket = 0; bucket < mac_bucket_count(); bucket++) {
+            uint32_t got = mac_bucket_read(bucket, info);
+            for (uint32_t i = 0; i < got; i++, n++) {
+                if (n < max) {
+                    out[n] = info[i];
+                }
+            }
+        }
+
+        if (locked) {
+            mac_table_unlock_all();
+            break;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&g_mac_table.displace_seq, __ATOMIC_RELAXED) == seq) {
+            break;
+        }
     }
-    
-    mac_table_acquire_lock();
-    
-    uint32_t hash = mac_hash(&mac, vlan_id);
-    mac_entry_t *entry = g_mac_table.entries[hash];
-    mac_entry_t *prev = NULL;
-    
-    while (entry != NULL) {
-        if (memcmp(entry->mac_addr.addr, mac.addr, MAC_ADDR_LEN) == 0 && 
-            entry->vlan_id == vlan_id) {
-            // Found the entry, remove it
-            if (prev == NULL) {
-                g_mac_table.entries[hash] = entry->next;
-            } else {
-                prev->next = entry->next;
+
+    if (n <= max && n > 1) {
+        uint32_t unique = 1;
+
+        qsort(out, n, sizeof(*out), mac_entry_info_compare);
+        for (uint32_t i = 1; i < n; i++) {
+            if (mac_entry_info_compare(&out[unique - 1], &out[i]) != 0) {
+                out[unique++] = out[i];
             }
-            
-            free(entry);
-            g_mac_table.count--;
-            
-            mac_table_release_lock();
-            
-            LOG_DEBUG(LOG_CATEGORY_L2, "Removed MAC entry: %02x:%02x:%02x:%02x:%02x:%02x VLAN %u",
-                     mac.addr[0], mac.addr[1], mac.addr[2], mac.addr[3], mac.addr[4], mac.addr[5], vlan_id);
-            return STATUS_SUCCESS;
         }
-        
-        prev = entry;
-        entry = entry->next;
+        n = unique;
     }
-    
-    mac_table_release_lock();
-    
-    LOG_DEBUG(LOG_CATEGORY_L2, "MAC entry not found for removal: %02x:%02x:%02x:%02x:%02x:%02x VLAN %u",
-             mac.addr[0], mac.addr[1], mac.addr[2], mac.addr[3], mac.addr[4], mac.addr[5], vlan_id);
-    return STATUS_NOT_FOUND;
+
+    *total = n;
 }
 
 /**
- * @brief Look up a MAC address in the table
+ * @brief Take a snapshot of the MAC table without blocking writers
  *
- * @param mac MAC address to look up
- * @param vlan_id VLAN ID
- * @param port_id Pointer to store the port ID if found
+ * @param snapshot Receives the snapshot
  * @return status_t Status code
  */
-status_t mac_table_lookup(const mac_addr_t mac, vlan_id_t vlan_id, 
-                         port_id_t *port_id) {
-    if (g_mac_table.entries == NULL) {
-        LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
-        return STATUS_NOT_INITIALIZED;
-    }
-    
-    if (port_id == NULL) {
-        LOG_ERROR(LOG_CATEGORY_L2, "NULL port_id pointer");
+status_t mac_table_snapshot_create(mac_table_snapshot_t *snapshot) {
+    if (snapshot == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "NULL snapshot pointer");
         return STATUS_INVALID_PARAMETER;
     }
     
-    mac_table_acquire_lock();
+    memset(snapshot, 0, sizeof(*snapshot));
+    if (g_mac_table.segments[0].entries == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
     
-    uint32_t hash = mac_hash(&mac, vlan_id);
-    mac_entry_t *entry = g_mac_table.entries[hash];
+    // Size for the current count plus some growth, and retry at the
+    // table's capacity if writers outran it
+    uint32_t capacity = __atomic_load_n(&g_mac_table.count, __ATOMIC_RELAXED);
+    capacity += capacity / 8 + MAC_BUCKET_SLOTS;
     
-    while (entry != NULL) {
-        if (memcmp(entry->mac_addr.addr, mac.addr, MAC_ADDR_LEN) == 0 && 
-            entry->vlan_id == vlan_id) {
-            // Found the entry
-            *port_id = entry->port_id;
-            entry->last_seen = g_mac_table.current_time;  // Update timestamp
-            
-            mac_table_release_lock();
-            
-            LOG_DEBUG(LOG_CATEGORY_L2, "MAC lookup found: %02x:%02x:%02x:%02x:%02x:%02x VLAN %u -> port %u",
-                     mac.addr[0], mac.addr[1], mac.addr[2], mac.addr[3], mac.addr[4], mac.addr[5], vlan_id, *port_id);
+    for (;;) {
+        uint32_t total;
+        
+        if (capacity > __atomic_load_n(&g_mac_table.size, __ATOMIC_RELAXED)) {
+            capacity = g_mac_table.size;
+        }
+        snapshot->entries = (mac_table_entry_t *)mem_malloc(MEM_TAG_MAC_TABLE, (size_t)capacity * sizeof(mac_table_entry_t));
+        if (snapshot->entries == NULL) {
+            LOG_ERROR(LOG_CATEGORY_L2, "Failed to allocate MAC table snapshot");
+            return STATUS_MEMORY_ALLOCATION_FAILED;
+        }
+        
+        snapshot->timestamp = __atomic_load_n(&g_mac_table.current_time, __ATOMIC_RELAXED);
+        mac_table_copy_entries(snapshot->entries, capacity, &total);
+        if (total <= capacity) {
+            snapshot->count = total;
             return STATUS_SUCCESS;
         }
         
-        entry = entry->next;
+        mem_free(MEM_TAG_MAC_TABLE, snapshot->entries);
+        capacity = total + total / 8;
+    }
+}
+
+/**
+ * @brief Release a snapshot taken by mac_table_snapshot_create()
+ *
+ * @param snapshot Snapshot to release
+ */
+void mac_table_snapshot_free(mac_table_snapshot_t *snapshot) {
+    if (snapshot == NULL) {
+        return;
     }
     
-    mac_table_release_lock();
-    
-    LOG_DEBUG(LOG_CATEGORY_L2, "MAC lookup not found: %02x:%02x:%02x:%02x:%02x:%02x VLAN %u",
-             mac.addr[0], mac.addr[1], mac.addr[2], mac.addr[3], mac.addr[4], mac.addr[5], vlan_id);
-    return STATUS_NOT_FOUND;
+    mem_free(MEM_TAG_MAC_TABLE, snapshot->entries);
+    snapshot->entries = NULL;
+    snapshot->count = 0;
 }
 
 /**
- * @brief Flush all entries from the MAC table
+ * @brief Get all entries in the MAC table
  *
- * @param vlan_id VLAN ID to flush (0 for all VLANs)
- * @param port_id Port ID to flush (PORT_ID_INVALID for all ports)
- * @param flush_static Whether to flush static entries too
+ * @param entries Array to store MAC table entries
+ * @param max_entries Size of the entries array
+ * @param count Output parameter to store number of entries returned
  * @return status_t Status code
  */
-status_t mac_table_flush(vlan_id_t vlan_id, port_id_t port_id, bool flush_static) {
-    if (g_mac_table.entries == NULL) {
+status_t mac_table_get_entries(mac_table_entry_t *entries, uint32_t max_entries, uint32_t *count) {
+    if (g_mac_table.segments[0].entries == NULL) {
         LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
         return STATUS_NOT_INITIALIZED;
     }
     
-    mac_table_acquire_lock();
+    if ((entries == NULL && max_entries > 0) || count == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "NULL entries pointer");
+        return STATUS_INVALID_PARAMETER;
+    }
     
-    uint32_t flushed = 0;
+    uint32_t total;
+    mac_table_copy_entries(entries, max_entries, &total);
     
-    // Iterate through all hash buckets
-    for (uint32_t i = 0; i < g_mac_table.size; i++) {
-        mac_entry_t *entry = g_mac_table.entries[i];
-        mac_entry_t *prev = NULL;
-        
-        while (entry != NULL) {
-            bool should_flush = true;
-            
-            // Check if this entry should be flushed based on criteria
-            if (vlan_id != 0 && entry->vlan_id != vlan_id) {
-                should_flush = false;
-            }
-            
-            if (port_id != PORT_ID_INVALID && entry->port_id != port_id) {
-                should_flush = false;
-            }
-            
-            if (!flush_static && entry->is_static) {
-                should_flush = false;
-            }
-            
-            if (should_flush) {
-                // Remove this entry
-                mac_entry_t *to_remove = entry;
-                
-                if (prev == NULL) {
-                    g_mac_table.entries[i] = entry->next;
-                    entry = entry->next;
-                } else {
-                    prev->next = entry->next;
-                    entry = entry->next;
-                }
-                
-                free(to_remove);
-                g_mac_table.count--;
-                flushed++;
-            } else {
-                // Keep this entry and move to next
-                prev = entry;
-                entry = entry->next;
-            }
-        }
+    if (total > max_entries) {
+        *count = max_entries;
+        return STATUS_OUT_OF_BOUNDS;
     }
     
-    mac_table_release_lock();
-    
-    LOG_INFO(LOG_CATEGORY_L2, "Flushed %u MAC table entries", flushed);
+    *count = total;
     return STATUS_SUCCESS;
 }
 
 /**
- * @brief Process aging of MAC table entries
+ * @brief Copy the entries of one step of a reverse binary walk
  *
- * Removes entries that have exceeded the aging time threshold.
- * This function should be called periodically by the system.
+ * A step is the bucket bits v select at the current level, together with
+ * the bucket it split into if it already did: every key whose hash half
+ * has those bits, whatever buckets have split since. The pair is read
+ * again if a split lands in between.
  *
- * @param table Pointer to the MAC table instance
- * @param current_time Current system time in seconds
- * @return status_t Status code
+ * @param v Bucket bits of the step
+ * @param info Receives up to 2 * MAC_BUCKET_SLOTS entries
+ * @param mask Receives the level mask the step was read at
+ * @return uint32_t Number of entries copied
  */
-status_t mac_table_process_aging(mac_table_t *table, uint32_t current_time) {
-    mac_table_internal_t *internal_table = (mac_table_internal_t *)table;
-    
-    if (internal_table == NULL) {
-        LOG_ERROR(LOG_CATEGORY_L2, "NULL MAC table pointer");
-        return STATUS_INVALID_PARAMETER;
-    }
-
-    if (internal_table->entries == NULL) {
-        LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
-        return STATUS_NOT_INITIALIZED;
-    }
+static uint32_t mac_table_read_step(uint32_t v, mac_table_entry_t *info, uint32_t *mask) {
+    uint64_t layout = __atomic_load_n(&g_mac_table.layout, __ATOMIC_ACQUIRE);
 
-    mac_table_acquire_lock();
+    for (;;) {
+        uint32_t bucket = v & (uint32_t)(layout >> 32);
+        uint32_t n = mac_bucket_read(bucket, info);
+        uint64_t now;
 
-    // Update the current time
-    internal_table->current_time = current_time;
-
-    uint32_t aged_out = 0;
-
-    // Iterate through all hash buckets
-    for (uint32_t i = 0; i < internal_table->size; i++) {
-        mac_entry_t *entry = internal_table->entries[i];
-        mac_entry_t *prev = NULL;
-
-        while (entry != NULL) {
-            // Skip static entries, they don't age
-            if (entry->is_static) {
-                prev = entry;
-                entry = entry->next;
-                continue;
-            }
+        if (bucket < (uint32_t)layout) {
+            n += mac_bucket_read(bucket + (uint32_t)(layout >> 32) + 1, &info[n]);
+        }
+        now = __atomic_load_n(&g_mac_table.layout, __ATOMIC_ACQUIRE);
+        if (now == layout) {
+            *mask = (uint32_t)(layout >> 32);
+            return n;
+        }
+        layout = now;
+    }
+}
 
-            // Check if this entry has aged out
-            uint32_t age = current_time - entry->last_seen;
-            if (age > internal_table->aging_time) {
-                // Remove this entry
-                mac_entry_t *to_remove = entry;
-
-                if (prev == NULL) {
-                    internal_table->entries[i] = entry->next;
-                    entry = entry->next;
-                } else {
-                    prev->next = entry->next;
-                    entry = entry->next;
-                }
+/**
+ * @brief Copy the entries of a page of walk steps from a cursor on
+ *
+ * Steps go in reverse binary order over the bits of the level mask, as
+ * described in table_cursor.h, so neither a split nor a new level between
+ * two pages makes keys repeat or go missing. A page ends between steps
+ * unless the first step alone holds more entries than fit.
+ *
+ * @param cursor Cursor of the first step
+ * @param out Output array
+ * @param max Size of the output array, at least 1
+ * @param count Receives the number of entries copied
+ * @return table_cursor_t Cursor after the entries copied
+ */
+static table_cursor_t mac_table_copy_page(table_cursor_t cursor, mac_table_entry_t *out,
+                                          uint32_t max, uint32_t *count) {
+    mac_table_entry_t info[2 * MAC_BUCKET_SLOTS];
+    uint32_t v = table_cursor_bucket(cursor);
+    uint32_t n = 0;
+    uint32_t mask;
+    uint32_t got = mac_table_read_step(v, info, &mask);
+    uint32_t skip = table_cursor_skip(cursor, mask);
 
-                LOG_DEBUG(LOG_CATEGORY_L2, "Aged out MAC entry: %02x:%02x:%02x:%02x:%02x:%02x VLAN %u Port %u",
-                         to_remove->mac_addr.addr[0], to_remove->mac_addr.addr[1],
-                         to_remove->mac_addr.addr[2], to_remove->mac_addr.addr[3],
-                         to_remove->mac_addr.addr[4], to_remove->mac_addr.addr[5],
-                         to_remove->vlan_id, to_remove->port_id);
+    for (;;) {
+        uint32_t left = got > skip ? got - skip : 0;
 
-                free(to_remove);
-                internal_table->count--;
-                aged_out++;
-            } else {
-                // Keep this entry and move to next
-                prev = entry;
-                entry = entry->next;
+        if (left > max - n) {
+            if (n == 0) {
+                memcpy(out, &info[skip], max * sizeof(*out));
+                n = max;
+                skip += max;
             }
+            break;
         }
+        if (left > 0) {
+            memcpy(&out[n], &info[skip], left * sizeof(*out));
+            n += left;
+        }
+        skip = 0;
+        v = table_cursor_next(v, mask);
+        if (v == 0) {
+            *count = n;
+            return TABLE_CURSOR_END;
+        }
+        if (n == max) {
+            break;
+        }
+        got = mac_table_read_step(v, info, &mask);
     }
 
-    mac_table_release_lock();
-
-    if (aged_out > 0) {
-        LOG_DEBUG(LOG_CATEGORY_L2, "Aged out %u MAC table entries", aged_out);
-    }
-
-    return STATUS_SUCCESS;
+    *count = n;
+    return table_cursor_make(v, mask, skip);
 }
 
 /**
- * @brief Get MAC table statistics
+ * @brief Get the next page of MAC table entries
  *
- * @param stats Pointer to statistics structure to fill
+ * Same retry scheme as mac_table_copy_entries(), for one page: the lock
+ * of every stripe is taken only for a page that displacements kept
+ * overlapping, and only while that page is copied.
+ *
+ * @param cursor Cursor, moved past the entries returned
+ * @param entries Array to store MAC table entries
+ * @param max_entries Size of the entries array
+ * @param count Output parameter to store number of entries returned
  * @return status_t Status code
  */
-status_t mac_table_get_stats(mac_table_stats_t *stats) {
-    if (g_mac_table.entries == NULL) {
+status_t mac_table_get_entries_page(table_cursor_t *cursor, mac_table_entry_t *entries,
+                                    uint32_t max_entries, uint32_t *count) {
+    if (g_mac_table.segments[0].entries == NULL) {
         LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
         return STATUS_NOT_INITIALIZED;
     }
     
-    if (stats == NULL) {
-        LOG_ERROR(LOG_CATEGORY_L2, "NULL stats pointer");
+    if (cursor == NULL || entries == NULL || max_entries == 0 || count == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Invalid parameters for MAC table page");
         return STATUS_INVALID_PARAMETER;
     }
     
-    mac_table_acquire_lock();
+    *count = 0;
+    if (*cursor == TABLE_CURSOR_END) {
+        return STATUS_SUCCESS;
+    }
     
-    // Count static and dynamic entries
-    uint32_t static_count = 0;
-    uint32_t dynamic_count = 0;
+    table_cursor_t next = TABLE_CURSOR_END;
     
-    for (uint32_t i = 0; i < g_mac_table.size; i++) {
-        mac_entry_t *entry = g_mac_table.entries[i];
+    for (int attempt = 0; attempt <= MAC_SNAPSHOT_RETRIES; attempt++) {
+        bool locked = attempt == MAC_SNAPSHOT_RETRIES;
+        uint32_t seq = 0;
         
-        while (entry != NULL) {
-            if (entry->is_static) {
-                static_count++;
-            } else {
-                dynamic_count++;
+        if (locked) {
+            mac_table_lock_all();
+        } else {
+            seq = __atomic_load_n(&g_mac_table.displace_seq, __ATOMIC_ACQUIRE);
+            if (seq & 1) {
+                continue;
             }
-            entry = entry->next;
+        }
+        
+        next = mac_table_copy_page(*cursor, entries, max_entries, count);
+        
+        if (locked) {
+            mac_table_unlock_all();
+            break;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&g_mac_table.displace_seq, __ATOMIC_RELAXED) == seq) {
+            break;
         }
     }
     
-    // Fill statistics
-    stats->total_entries = g_mac_table.count;
-    stats->static_entries = static_count;
-    stats->dynamic_entries = dynamic_count;
-    stats->table_size = g_mac_table.size;
-    stats->aging_time = g_mac_table.aging_time;
-    
-    mac_table_release_lock();
-    
+    *cursor = next;
     return STATUS_SUCCESS;
 }
 
 /**
- * @brief Set MAC table aging time
+ * @brief Export the MAC table as a packed binary image
  *
- * @param aging_time New aging time in seconds
+ * @param buffer Output buffer
+ * @param size Size of the buffer in bytes
+ * @param written Receives the bytes written, or needed if too small
  * @return status_t Status code
  */
-status_t mac_table_set_aging_time(uint32_t aging_time) {
-    if (g_mac_table.entries == NULL) {
-        LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
-        return STATUS_NOT_INITIALIZED;
+status_t mac_table_export(void *buffer, uint32_t size, uint32_t *written) {
+    if ((buffer == NULL && size > 0) || written == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "NULL export buffer");
+        return STATUS_INVALID_PARAMETER;
     }
     
-    if (aging_time == 0) {
-        LOG_ERROR(LOG_CATEGORY_L2, "Invalid aging time: %u", aging_time);
-        return STATUS_INVALID_PARAMETER;
+    mac_table_snapshot_t snapshot;
+    status_t status = mac_table_snapshot_create(&snapshot);
+    if (status != STATUS_SUCCESS) {
+        return status;
     }
     
-    mac_table_acquire_lock();
-    g_mac_table.aging_time = aging_time;
-    mac_table_release_lock();
+    uint64_t needed = sizeof(mac_table_export_header_t) +
+                      (uint64_t)snapshot.count * sizeof(mac_table_export_record_t);
+    if (needed > size) {
+        *written = (uint32_t)needed;
+        mac_table_snapshot_free(&snapshot);
+        return STATUS_OUT_OF_BOUNDS;
+    }
     
-    LOG_INFO(LOG_CATEGORY_L2, "MAC table aging time set to %u seconds", aging_time);
+    mac_table_export_header_t header = {
+        .magic = MAC_TABLE_EXPORT_MAGIC,
+        .version = MAC_TABLE_EXPORT_VERSION,
+        .record_size = sizeof(mac_table_export_record_t),
+        .count = snapshot.count,
+        .timestamp = snapshot.timestamp,
+    };
+    uint8_t *out = (uint8_t *)buffer;
+    memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    
+    for (uint32_t i = 0; i < snapshot.count; i++) {
+        const mac_table_entry_t *entry = &snapshot.entries[i];
+        mac_table_export_record_t record = {
+            .vlan_id = entry->vlan_id,
+            .port_id = entry->port_id,
+            .type = (uint8_t)entry->type,
+            .aging = (uint8_t)entry->aging,
+            .age_timestamp = entry->age_timestamp,
+        };
+        memcpy(record.mac_addr, entry->mac_addr.addr, MAC_ADDR_LEN);
+        memcpy(out, &record, sizeof(record));
+        out += sizeof(record);
+    }
+    
+    *written = (uint32_t)needed;
+    mac_table_snapshot_free(&snapshot);
     return STATUS_SUCCESS;
 }
 
@@ -608,14 +2866,15 @@ status_t mac_table_set_aging_time(uint32_t aging_time) {
  * @brief Iterate through MAC table entries
  *
  * This function allows the caller to iterate through all MAC table entries
- * and perform an action on each one via the callback function.
+ * and perform an action on each one via the callback function. The
+ * callbacks run on a snapshot, so they may add or remove entries.
  *
  * @param callback Function to call for each entry
  * @param user_data User data to pass to the callback
  * @return status_t Status code
  */
 status_t mac_table_iterate(mac_table_iter_cb_t callback, void *user_data) {
-    if (g_mac_table.entries == NULL) {
+    if (g_mac_table.segments[0].entries == NULL) {
         LOG_ERROR(LOG_CATEGORY_L2, "MAC table not initialized");
         return STATUS_NOT_INITIALIZED;
     }
@@ -625,36 +2884,86 @@ status_t mac_table_iterate(mac_table_iter_cb_t callback, void *user_data) {
         return STATUS_INVALID_PARAMETER;
     }
     
-    mac_table_acquire_lock();
-    
-    mac_entry_info_t info;
-    bool continue_iteration = true;
+    mac_table_snapshot_t snapshot;
+    status_t status = mac_table_snapshot_create(&snapshot);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
     
-    // Iterate through all hash buckets
-    for (uint32_t i = 0; i < g_mac_table.size && continue_iteration; i++) {
-        mac_entry_t *entry = g_mac_table.entries[i];
-        
-        while (entry != NULL && continue_iteration) {
-            // Fill entry info for callback
-            memcpy(info.mac_addr.addr, entry->mac_addr.addr, MAC_ADDR_LEN);
-            info.port_id = entry->port_id;
-            info.vlan_id = entry->vlan_id;
-            //info.is_static = entry->is_static;
-            info.type = entry->is_static ? MAC_ENTRY_TYPE_STATIC : MAC_ENTRY_TYPE_DYNAMIC;
-            //info.age = g_mac_table.current_time - entry->last_seen;
-            //info.age_timestamp = entry->last_seen;  // или g_mac_table.current_time - entry->last_seen
-            info.last_used_time = entry->last_seen; // возможно, это более подходящее поле
-            
-            // Call the callback function
-            continue_iteration = callback(&info, user_data);
-            
-            entry = entry->next;
+    // Call the callback function
+    for (uint32_t i = 0; i < snapshot.count; i++) {
+        if (!callback(&snapshot.entries[i], user_data)) {
+            break;
         }
     }
     
-    mac_table_release_lock();
+    mac_table_snapshot_free(&snapshot);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Register callback for MAC address change events
+ *
+ * @param callback Function to call when MAC events occur
+ * @param user_data User data to pass to callback
+ * @return status_t Status code
+ */
+status_t mac_table_register_event_callback(mac_event_callback_t callback, void *user_data) {
+    if (callback == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "NULL callback function");
+        return STATUS_INVALID_PARAMETER;
+    }
+    
+    // mac_table_notify() reads these without the lock: context first
+    spinlock_acquire(&g_mac_table.event_lock);
+    __atomic_store_n(&g_mac_table.event_callback, NULL, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_mac_table.event_user_data, user_data, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_mac_table.event_callback, callback, __ATOMIC_RELEASE);
+    spinlock_release(&g_mac_table.event_lock);
     
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Unregister previously registered MAC event callback
+ *
+ * @return status_t Status code
+ */
+status_t mac_table_unregister_event_callback(void) {
+    spinlock_acquire(&g_mac_table.event_lock);
+    __atomic_store_n(&g_mac_table.event_callback, NULL, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_mac_table.event_user_data, NULL, __ATOMIC_RELAXED);
+    spinlock_release(&g_mac_table.event_lock);
+    
+    return STATUS_SUCCESS;
+}
 
+/**
+ * @brief Get the most recent MAC move dampening events
+ *
+ * @param events Array to store the events, oldest first
+ * @param max_events Size of the events array
+ * @param count Output parameter to store number of events returned
+ * @return status_t Status code
+ */
+status_t mac_table_get_move_events(mac_move_event_t *events, uint32_t max_events, uint32_t *count) {
+    if (events == NULL || count == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L2, "NULL move events pointer");
+        return STATUS_INVALID_PARAMETER;
+    }
+    
+    spinlock_acquire(&g_mac_table.event_lock);
+    
+    uint32_t total = g_mac_table.move_event_count;
+    uint32_t kept = total < MAC_MOVE_EVENT_RING_SIZE ? total : MAC_MOVE_EVENT_RING_SIZE;
+    uint32_t n = kept < max_events ? kept : max_events;
+    
+    for (uint32_t i = 0; i < n; i++) {
+        events[i] = g_mac_table.move_events[(total - n + i) % MAC_MOVE_EVENT_RING_SIZE];
+    }
+    
+    spinlock_release(&g_mac_table.event_lock);
+    
+    *count = n;
+    return STATUS_SUCCESS;
+}
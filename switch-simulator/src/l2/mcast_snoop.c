@@ -0,0 +1,1192 @@
+/**
+ * @file mcast_snoop.c
+ * @brief Implementation of IGMP and MLD snooping
+ *
+ * A key is the group MAC in bits 63..16, MCAST_KEY_VALID and the VLAN in
+ * bits 15..0, as in the MAC table; the router ports of a VLAN are kept
+ * under the all-zero MAC, which no group maps to. Every key lives in one
+ * of two candidate buckets of four keys. The member bitmap of a slot is
+ * in a parallel array, and its aging state in another one only writers
+ * touch.
+ *
+ * Lookups take no lock: a writer makes the table sequence odd while it
+ * changes keys or member bitmaps, and a reader retries if the sequence
+ * was odd or moved while it read. Membership changes as often as hosts
+ * report, far less than frames arrive, so one sequence serves the table
+ * and a key that finds both buckets full is refused rather than displaced.
+ *
+ * Writers hold the state lock. Timers are items {key, deadline} in a
+ * wheel of one-second slots; an item is stale once its key is gone or
+ * its deadline is not the entry's queued one. Deadlines past the wheel's
+ * span wait in their slot for as many turns as they need.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/config.h"
+#include "common/keyed_hash.h"
+#include "common/logging.h"
+#include "common/threading.h"
+#include "common/seqlock.h"
+#include "common/switch_context.h"
+#include "common/bitmap.h"
+#include "l2/mcast_snoop.h"
+
+/**
+ * @brief Keys per bucket
+ */
+#define MCAST_BUCKET_SLOTS      4
+
+/**
+ * @brief Marks a key slot as occupied; an all-zero key is an empty slot
+ */
+#define MCAST_KEY_VALID         0x8000
+
+/**
+ * @brief Timer wheel of one-second slots (power of 2)
+ */
+#define MCAST_WHEEL_BITS        9
+#define MCAST_WHEEL_SLOTS       (1u << MCAST_WHEEL_BITS)
+
+/**
+ * @brief Protocol numbers and message types
+ */
+#define MCAST_IPPROTO_IGMP      2
+#define MCAST_IPPROTO_ICMPV6    58
+#define MCAST_IPPROTO_PIM       103
+#define IGMP_QUERY              0x11
+#define IGMP_V1_REPORT          0x12
+#define IGMP_V2_REPORT          0x16
+#define IGMP_V2_LEAVE           0x17
+#define IGMP_V3_REPORT          0x22
+#define MLD_QUERY               130
+#define MLD_V1_REPORT           131
+#define MLD_V1_DONE             132
+#define MLD_V2_REPORT           143
+#define PIM_HELLO               0
+
+/**
+ * @brief Group record types of IGMPv3 and MLDv2 reports
+ */
+#define MCAST_MODE_IS_INCLUDE   1
+#define MCAST_MODE_IS_EXCLUDE   2
+#define MCAST_CHANGE_TO_INCLUDE 3
+#define MCAST_CHANGE_TO_EXCLUDE 4
+#define MCAST_ALLOW_NEW_SOURCES 5
+
+/**
+ * @brief Message lengths: fixed header and group record header
+ */
+#define IGMP_MIN_LEN            8
+#define IGMP_V3_RECORD_LEN      8
+#define MLD_MIN_LEN             24
+#define MLD_V2_REPORT_MIN_LEN   8
+#define MLD_V2_RECORD_LEN       20
+
+#define MCAST_DEFAULT_INTERVAL  260
+#define MCAST_DEFAULT_LAST_MEMBER_TIME 2
+
+/**
+ * @brief Bucket of keys, half a cache line
+ */
+typedef struct {
+    uint64_t keys[MCAST_BUCKET_SLOTS];
+} __attribute__((aligned(32))) mcast_bucket_t;
+
+/**
+ * @brief Aging state of a slot, parallel to the keys
+ */
+typedef struct {
+    vlan_port_bitmap_t fresh;       // Members heard from in the current epoch
+    vlan_port_bitmap_t leaving;     // Members that left, removed at leave_at
+    vlan_port_bitmap_t statics;     // Members that never age (router ports only)
+    uint32_t epoch_end;             // End of the current epoch
+    uint32_t leave_at;              // Deadline of the leaving members, 0 if none
+    uint32_t queued;                // Deadline of the slot's current wheel item, 0 if none
+} mcast_entry_t;
+
+/**
+ * @brief Timer wheel item
+ */
+typedef struct {
+    uint64_t key;                   // Key of the entry
+    uint32_t deadline;              // Second the item is due
+} mcast_wheel_item_t;
+
+/**
+ * @brief Timer wheel slot, a growable array of items
+ */
+typedef struct {
+    mcast_wheel_item_t *items;
+    uint32_t count;
+    uint32_t capacity;
+} mcast_wheel_slot_t;
+
+/**
+ * @brief What a control frame was
+ */
+typedef enum {
+    MCAST_CTRL_NONE = 0,            // Not IGMP, MLD or PIM
+    MCAST_CTRL_REPORT,              // Report or leave, goes to router ports
+    MCAST_CTRL_QUERY                // Query or PIM hello, floods
+} mcast_ctrl_t;
+
+/**
+ * @brief Snooping state of one switch instance
+ */
+typedef struct {
+    bool initialized;
+    spinlock_t lock;                // Serializes writers of everything below
+    seqlock_t seq;                  // Odd while a writer changes keys or member bitmaps
+    mcast_bucket_t *buckets;        // Keys
+    vlan_port_bitmap_t *ports;      // Members, indexed by bucket * MCAST_BUCKET_SLOTS + slot
+    mcast_entry_t *entries;         // Aging state, same index
+    uint32_t bucket_mask;           // Number of buckets - 1
+    uint32_t max_groups;            // Entry limit
+    uint32_t count;                 // Entries, router port sets included
+    uint32_t groups;                // Group entries
+    uint32_t current_time;          // Time of the last timer run
+    uint64_t enabled[VLAN_ID_WORDS]; // VLANs with snooping
+    mcast_snoop_config_t config;
+    mcast_wheel_slot_t wheel[MCAST_WHEEL_SLOTS];
+    uint32_t wheel_time;            // Last second processed
+    mcast_snoop_stats_t stats;      // forwarded and unregistered are updated atomically
+} mcast_state_t;
+
+/**
+ * @brief Snooping state of each switch instance
+ *
+ * Instance 0 is static; mcast_snoop_init() allocates the others.
+ */
+static mcast_state_t g_mcast_state_default;
+static mcast_state_t *g_mcast_states[CONFIG_MAX_SWITCH_INSTANCES] = { &g_mcast_state_default };
+
+/**
+ * @brief State of the calling thread's instance, NULL if never initialized
+ */
+static inline mcast_state_t *mcast_state(void) {
+    return g_mcast_states[switch_context_current()];
+}
+
+static inline uint16_t mcast_read_be16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t mcast_read_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * @brief Pack a group MAC and VLAN into a key, never 0
+ */
+static inline uint64_t mcast_key(const uint8_t *mac, vlan_id_t vlan_id) {
+    uint64_t key = 0;
+
+    for (int i = 0; i < MAC_ADDR_LEN; i++) {
+        key = (key << 8) | mac[i];
+    }
+    return (key << 16) | MCAST_KEY_VALID | (vlan_id & (MCAST_KEY_VALID - 1));
+}
+
+/**
+ * @brief Key of the router port set of a VLAN
+ */
+static inline uint64_t mcast_router_key(vlan_id_t vlan_id) {
+    return MCAST_KEY_VALID | (vlan_id & (MCAST_KEY_VALID - 1));
+}
+
+static inline bool mcast_key_is_router(uint64_t key) {
+    return (key >> 16) == 0;
+}
+
+/**
+ * @brief Keyed hash of a key; the two halves select the two buckets
+ */
+static inline uint64_t mcast_hash(uint64_t key) {
+    return keyed_hash_u64(key);
+}
+
+static inline void mcast_buckets(const mcast_state_t *st, uint64_t key, uint32_t *b1, uint32_t *b2) {
+    uint64_t hash = mcast_hash(key);
+
+    *b1 = (uint32_t)hash & st->bucket_mask;
+    *b2 = (uint32_t)(hash >> 32) & st->bucket_mask;
+    if (*b2 == *b1) {
+        *b2 ^= 1;
+    }
+}
+
+/**
+ * @brief Slot of a key, -1 if absent; safe without the lock inside a read section
+ */
+static int64_t mcast_find(const mcast_state_t *st, uint64_t key) {
+    uint32_t b[2];
+
+    mcast_buckets(st, key, &b[0], &b[1]);
+    for (int i = 0; i < 2; i++) {
+        const mcast_bucket_t *bucket = &st->buckets[b[i]];
+        for (uint32_t s = 0; s < MCAST_BUCKET_SLOTS; s++) {
+            if (__atomic_load_n(&bucket->keys[s], __ATOMIC_RELAXED) == key) {
+                return (int64_t)b[i] * MCAST_BUCKET_SLOTS + s;
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Whether a group MAC is snooped; link-local scope groups always flood
+ */
+static inline bool mcast_mac_snooped(const uint8_t *mac) {
+    if (mac[0] == 0x01 && mac[1] == 0x00 && mac[2] == 0x5E) {
+        return (mac[3] & 0x80) == 0 && (mac[3] | mac[4]) != 0;
+    }
+    if (mac[0] == 0x33 && mac[1] == 0x33) {
+        return (mac[2] | mac[3] | mac[4]) != 0;
+    }
+    return false;
+}
+
+/* Word by word with atomic loads, as writers may change the bitmap meanwhile */
+static inline void mcast_bitmap_or(vlan_port_bitmap_t *to, const vlan_port_bitmap_t *from) {
+    for (uint32_t w = 0; w < VLAN_PORT_WORDS; w++) {
+        to->w[w] |= __atomic_load_n(&from->w[w], __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Read the members of a group and the router ports of its VLAN
+ *
+ * @param group_key Group key, 0 for the router ports only
+ * @param router_key Router port set key
+ * @param[out] ports Union of both
+ * @return true if the group has members
+ */
+static bool mcast_read(const mcast_state_t *st, uint64_t group_key, uint64_t router_key,
+                       vlan_port_bitmap_t *ports) {
+    for (;;) {
+        uint32_t seq = seqlock_read_begin(&st->seq);
+
+        int64_t slot = group_key ? mcast_find(st, group_key) : -1;
+        bool found = slot >= 0;
+
+        memset(ports, 0, sizeof(*ports));
+        if (found) {
+            mcast_bitmap_or(ports, &st->ports[slot]);
+        }
+        slot = mcast_find(st, router_key);
+        if (slot >= 0) {
+            mcast_bitmap_or(ports, &st->ports[slot]);
+        }
+
+        if (!seqlock_read_retry(&st->seq, seq)) {
+            return found;
+        }
+    }
+}
+
+/**
+ * @brief Start changing keys or member bitmaps; the caller holds the lock
+ */
+static inline void mcast_write_begin(mcast_state_t *st) {
+    seqlock_write_begin(&st->seq);
+}
+
+/**
+ * @brief Publish the changes made since mcast_write_begin()
+ */
+static inline void mcast_write_end(mcast_state_t *st) {
+    seqlock_write_end(&st->seq);
+}
+
+/**
+ * @brief Set or clear one member bit of a slot
+ */
+static void mcast_set_member(mcast_state_t *st, uint32_t slot, port_id_t port_id, bool member) {
+    uint64_t *word = &st->ports[slot].w[port_id / 64];
+    uint64_t bit = 1ULL << (port_id % 64);
+    uint64_t value = member ? (*word | bit) : (*word & ~bit);
+
+    if (value != *word) {
+        mcast_write_begin(st);
+        __atomic_store_n(word, value, __ATOMIC_RELAXED);
+        mcast_write_end(st);
+    }
+}
+
+/**
+ * @brief Epoch length of an entry: half its interval
+ */
+static inline uint32_t mcast_epoch(const mcast_state_t *st, uint64_t key) {
+    uint32_t interval = mcast_key_is_router(key) ? st->config.router_interval : st->config.membership_interval;
+    return interval / 2;
+}
+
+/**
+ * @brief Queue a wheel item for an entry unless one is due no later
+ */
+static void mcast_queue(mcast_state_t *st, uint64_t key, mcast_entry_t *entry, uint32_t deadline) {
+    if (entry->queued != 0 && entry->queued <= deadline) {
+        return;
+    }
+    if ((int32_t)(deadline - st->wheel_time) <= 0) {
+        deadline = st->wheel_time + 1;
+    }
+
+    mcast_wheel_slot_t *slot = &st->wheel[deadline & (MCAST_WHEEL_SLOTS - 1)];
+    if (slot->count == slot->capacity) {
+        uint32_t capacity = slot->capacity ? slot->capacity * 2 : 16;
+        mcast_wheel_item_t *items = (mcast_wheel_item_t *)realloc(slot->items, capacity * sizeof(*items));
+        if (!items) {
+            // Without its item the entry lives until the VLAN or port is flushed
+            LOG_WARNING_RATELIMITED(LOG_CATEGORY_L2, "MCAST: No memory for a group timer");
+            return;
+        }
+        slot->items = items;
+        slot->capacity = capacity;
+    }
+    slot->items[slot->count].key = key;
+    slot->items[slot->count].deadline = deadline;
+    slot->count++;
+    entry->queued = deadline;
+}
+
+/**
+ * @brief Slot of a key, inserted with no members if absent; -1 if the table is full
+ */
+static int64_t mcast_get_or_insert(mcast_state_t *st, uint64_t key) {
+    int64_t slot = mcast_find(st, key);
+    uint32_t b[2];
+
+    if (slot >= 0) {
+        return slot;
+    }
+    if (st->count >= st->max_groups) {
+        st->stats.table_full++;
+        return -1;
+    }
+
+    mcast_buckets(st, key, &b[0], &b[1]);
+    for (int i = 0; i < 2; i++) {
+        mcast_bucket_t *bucket = &st->buckets[b[i]];
+        for (uint32_t s = 0; s < MCAST_BUCKET_SLOTS; s++) {
+            if (bucket->keys[s] != 0) {
+                continue;
+            }
+            uint32_t index = b[i] * MCAST_BUCKET_SLOTS + s;
+            mcast_entry_t *entry = &st->entries[index];
+
+            memset(entry, 0, sizeof(*entry));
+            entry->epoch_end = st->current_time + mcast_epoch(st, key);
+            mcast_write_begin(st);
+            memset(&st->ports[index], 0, sizeof(st->ports[index]));
+            __atomic_store_n(&bucket->keys[s], key, __ATOMIC_RELAXED);
+            mcast_write_end(st);
+
+            st->count++;
+            if (!mcast_key_is_router(key)) {
+                st->groups++;
+            }
+            mcast_queue(st, key, entry, entry->epoch_end);
+            return index;
+        }
+    }
+
+    st->stats.table_full++;
+    return -1;
+}
+
+/**
+ * @brief Remove the entry of a slot; its wheel item goes stale
+ */
+static void mcast_remove(mcast_state_t *st, uint32_t slot) {
+    uint64_t *key = &st->buckets[slot / MCAST_BUCKET_SLOTS].keys[slot % MCAST_BUCKET_SLOTS];
+
+    if (!mcast_key_is_router(*key)) {
+        st->groups--;
+    }
+    mcast_write_begin(st);
+    __atomic_store_n(key, 0, __ATOMIC_RELAXED);
+    memset(&st->ports[slot], 0, sizeof(st->ports[slot]));
+    mcast_write_end(st);
+    memset(&st->entries[slot], 0, sizeof(st->entries[slot]));
+    st->count--;
+}
+
+/**
+ * @brief A port reported a group, or a query or hello arrived on it
+ */
+static void mcast_join(mcast_state_t *st, uint64_t key, port_id_t port_id) {
+    int64_t slot = mcast_get_or_insert(st, key);
+
+    if (slot < 0) {
+        return;
+    }
+    mcast_entry_t *entry = &st->entries[slot];
+    entry->fresh.w[port_id / 64] |= 1ULL << (port_id % 64);
+    entry->leaving.w[port_id / 64] &= ~(1ULL << (port_id % 64));
+    mcast_set_member(st, (uint32_t)slot, port_id, true);
+}
+
+/**
+ * @brief A port left a group
+ */
+static void mcast_leave(mcast_state_t *st, uint64_t key, port_id_t port_id) {
+    int64_t slot = mcast_find(st, key);
+
+    if (slot < 0 || !bitmap_test(st->ports[slot].w, port_id)) {
+        return;
+    }
+
+    mcast_entry_t *entry = &st->entries[slot];
+    entry->fresh.w[port_id / 64] &= ~(1ULL << (port_id % 64));
+    if (st->config.fast_leave || st->config.last_member_time == 0) {
+        entry->leaving.w[port_id / 64] &= ~(1ULL << (port_id % 64));
+        mcast_set_member(st, (uint32_t)slot, port_id, false);
+        if (bitmap_empty(st->ports[slot].w, VLAN_PORT_WORDS)) {
+            mcast_remove(st, (uint32_t)slot);
+        }
+        return;
+    }
+
+    // The querier asks who is left; ports that answer stay
+    entry->leaving.w[port_id / 64] |= 1ULL << (port_id % 64);
+    if (entry->leave_at == 0) {
+        entry->leave_at = st->current_time + st->config.last_member_time;
+        mcast_queue(st, key, entry, entry->leave_at);
+    }
+}
+
+/**
+ * @brief Age the entry of a due wheel item
+ */
+static void mcast_age(mcast_state_t *st, uint32_t slot, uint64_t key, uint32_t now) {
+    mcast_entry_t *entry = &st->entries[slot];
+    vlan_port_bitmap_t members = st->ports[slot];
+    bool changed = false;
+
+    entry->queued = 0;
+    for (uint32_t w = 0; w < VLAN_PORT_WORDS; w++) {
+        uint64_t keep = members.w[w];
+        if (entry->leave_at != 0 && (int32_t)(now - entry->leave_at) >= 0) {
+            keep &= ~(entry->leaving.w[w] & ~entry->statics.w[w]);
+        }
+        if ((int32_t)(now - entry->epoch_end) >= 0) {
+            keep &= entry->fresh.w[w] | entry->statics.w[w];
+        }
+        changed |= keep != members.w[w];
+        members.w[w] = keep;
+    }
+    if (entry->leave_at != 0 && (int32_t)(now - entry->leave_at) >= 0) {
+        memset(&entry->leaving, 0, sizeof(entry->leaving));
+        entry->leave_at = 0;
+    }
+    if ((int32_t)(now - entry->epoch_end) >= 0) {
+        memset(&entry->fresh, 0, sizeof(entry->fresh));
+        entry->epoch_end = now + mcast_epoch(st, key);
+    }
+
+    if (bitmap_empty(members.w, VLAN_PORT_WORDS)) {
+        mcast_remove(st, slot);
+        return;
+    }
+    if (changed) {
+        mcast_write_begin(st);
+        for (uint32_t w = 0; w < VLAN_PORT_WORDS; w++) {
+            __atomic_store_n(&st->ports[slot].w[w], members.w[w], __ATOMIC_RELAXED);
+        }
+        mcast_write_end(st);
+    }
+
+    uint32_t next = entry->epoch_end;
+    if (entry->leave_at != 0 && (int32_t)(entry->leave_at - next) < 0) {
+        next = entry->leave_at;
+    }
+    mcast_queue(st, key, entry, next);
+}
+
+/**
+ * @brief Handle the items of one wheel slot due at now
+ */
+static void mcast_wheel_slot_run(mcast_state_t *st, mcast_wheel_slot_t *slot, uint32_t now) {
+    uint32_t count = slot->count;
+    uint32_t kept = 0;
+
+    // Items queued while the slot runs land after count and are kept
+    for (uint32_t i = 0; i < count; i++) {
+        mcast_wheel_item_t item = slot->items[i];
+        int64_t index = mcast_find(st, item.key);
+
+        if (index < 0 || st->entries[index].queued != item.deadline) {
+            continue;
+        }
+        if ((int32_t)(item.deadline - now) > 0) {
+            // Not this turn
+            slot->items[kept++] = item;
+            continue;
+        }
+        mcast_age(st, (uint32_t)index, item.key, now);
+    }
+
+    if (slot->count > count) {
+        memmove(&slot->items[kept], &slot->items[count], (slot->count - count) * sizeof(slot->items[0]));
+    }
+    slot->count = kept + (slot->count - count);
+}
+
+/**
+ * @brief Initialize snooping of the current switch instance
+ *
+ * @param max_groups Table capacity, 0 for the default
+ * @return status_t Status code
+ */
+status_t mcast_snoop_init(uint32_t max_groups) {
+    uint32_t instance = switch_context_current();
+    mcast_state_t *st;
+    uint32_t buckets = 2;
+
+    keyed_hash_init();
+    if (max_groups == 0) {
+        max_groups = CONFIG_MCAST_SNOOP_MAX_GROUPS;
+    }
+    // Two candidate buckets of four keep inserts succeeding below 90% load
+    while ((uint64_t)buckets * MCAST_BUCKET_SLOTS * 9 < (uint64_t)max_groups * 10) {
+        buckets *= 2;
+    }
+
+    if (g_mcast_states[instance] == NULL) {
+        g_mcast_states[instance] = (mcast_state_t *)calloc(1, sizeof(mcast_state_t));
+        if (!g_mcast_states[instance]) {
+            LOG_ERROR(LOG_CATEGORY_L2, "MCAST: Failed to allocate state of switch instance %u", instance);
+            return STATUS_NO_MEMORY;
+        }
+    }
+    st = g_mcast_states[instance];
+
+    if (st->initialized) {
+        LOG_WARNING(LOG_CATEGORY_L2, "MCAST: Module already initialized");
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    st->buckets = (mcast_bucket_t *)aligned_alloc(sizeof(mcast_bucket_t), buckets * sizeof(mcast_bucket_t));
+    st->ports = (vlan_port_bitmap_t *)calloc(buckets * MCAST_BUCKET_SLOTS, sizeof(vlan_port_bitmap_t));
+    st->entries = (mcast_entry_t *)calloc(buckets * MCAST_BUCKET_SLOTS, sizeof(mcast_entry_t));
+    if (!st->buckets || !st->ports || !st->entries) {
+        LOG_ERROR(LOG_CATEGORY_L2, "MCAST: Failed to allocate a table of %u groups", max_groups);
+        free(st->buckets);
+        free(st->ports);
+        free(st->entries);
+        st->buckets = NULL;
+        st->ports = NULL;
+        st->entries = NULL;
+        return STATUS_NO_MEMORY;
+    }
+    memset(st->buckets, 0, buckets * sizeof(mcast_bucket_t));
+
+    spinlock_init(&st->lock);
+    seqlock_init(&st->seq);
+    st->bucket_mask = buckets - 1;
+    st->max_groups = max_groups;
+    st->count = 0;
+    st->groups = 0;
+    st->current_time = 0;
+    st->wheel_time = 0;
+    memset(st->enabled, 0, sizeof(st->enabled));
+    memset(st->wheel, 0, sizeof(st->wheel));
+    memset(&st->stats, 0, sizeof(st->stats));
+    mcast_snoop_get_default_config(&st->config);
+    __atomic_store_n(&st->initialized, true, __ATOMIC_RELEASE);
+
+    LOG_INFO(LOG_CATEGORY_L2, "MCAST: Snooping initialized, %u groups", max_groups);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Free the snooping state of the current instance
+ *
+ * @return status_t Status code
+ */
+status_t mcast_snoop_deinit(void) {
+    uint32_t instance = switch_context_current();
+    mcast_state_t *st = g_mcast_states[instance];
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    spinlock_acquire(&st->lock);
+    __atomic_store_n(&st->initialized, false, __ATOMIC_RELEASE);
+    for (uint32_t i = 0; i < MCAST_WHEEL_SLOTS; i++) {
+        free(st->wheel[i].items);
+    }
+    memset(st->wheel, 0, sizeof(st->wheel));
+    free(st->buckets);
+    free(st->ports);
+    free(st->entries);
+    st->buckets = NULL;
+    st->ports = NULL;
+    st->entries = NULL;
+    spinlock_release(&st->lock);
+
+    if (instance != SWITCH_INSTANCE_DEFAULT) {
+        g_mcast_states[instance] = NULL;
+        free(st);
+    }
+
+    LOG_INFO(LOG_CATEGORY_L2, "MCAST: Snooping cleaned up");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Fill a configuration with the defaults
+ *
+ * @param config Configuration to fill
+ */
+void mcast_snoop_get_default_config(mcast_snoop_config_t *config) {
+    if (!config) {
+        return;
+    }
+    config->membership_interval = MCAST_DEFAULT_INTERVAL;
+    config->router_interval = MCAST_DEFAULT_INTERVAL;
+    config->last_member_time = MCAST_DEFAULT_LAST_MEMBER_TIME;
+    config->fast_leave = false;
+    config->flood_unregistered = false;
+}
+
+/**
+ * @brief Set the configuration
+ *
+ * @param config Configuration
+ * @return status_t Status code
+ */
+status_t mcast_snoop_set_config(const mcast_snoop_config_t *config) {
+    mcast_state_t *st = mcast_state();
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!config || config->membership_interval < 2 || config->router_interval < 2) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    st->config = *config;
+    spinlock_release(&st->lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Enable or disable snooping on a VLAN
+ *
+ * @param vlan_id VLAN
+ * @param enable Whether multicast of the VLAN is constrained
+ * @return status_t Status code
+ */
+status_t mcast_snoop_set_vlan(vlan_id_t vlan_id, bool enable) {
+    mcast_state_t *st = mcast_state();
+    uint64_t bit = 1ULL << (vlan_id % 64);
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (vlan_id < VLAN_ID_MIN || vlan_id > VLAN_ID_MAX) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    if (enable) {
+        __atomic_fetch_or(&st->enabled[vlan_id / 64], bit, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_and(&st->enabled[vlan_id / 64], ~bit, __ATOMIC_RELAXED);
+        for (uint32_t slot = 0; slot < (st->bucket_mask + 1) * MCAST_BUCKET_SLOTS; slot++) {
+            uint64_t key = st->buckets[slot / MCAST_BUCKET_SLOTS].keys[slot % MCAST_BUCKET_SLOTS];
+            if (key != 0 && (vlan_id_t)(key & (MCAST_KEY_VALID - 1)) == vlan_id) {
+                mcast_remove(st, slot);
+            }
+        }
+    }
+    spinlock_release(&st->lock);
+
+    LOG_INFO(LOG_CATEGORY_L2, "MCAST: Snooping %s on VLAN %u", enable ? "enabled" : "disabled", vlan_id);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Pin a router port or return it to detection
+ *
+ * @param vlan_id VLAN
+ * @param port_id Port or LAG
+ * @param is_static true to pin the port
+ * @return status_t Status code
+ */
+status_t mcast_snoop_set_router_port(vlan_id_t vlan_id, port_id_t port_id, bool is_static) {
+    mcast_state_t *st = mcast_state();
+    uint64_t key = mcast_router_key(vlan_id);
+    status_t status = STATUS_SUCCESS;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (vlan_id < VLAN_ID_MIN || vlan_id > VLAN_ID_MAX || port_id >= CONFIG_MAX_PORTS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    if (is_static) {
+        int64_t slot = mcast_get_or_insert(st, key);
+        if (slot < 0) {
+            status = STATUS_TABLE_FULL;
+        } else {
+            st->entries[slot].statics.w[port_id / 64] |= 1ULL << (port_id % 64);
+            mcast_set_member(st, (uint32_t)slot, port_id, true);
+        }
+    } else {
+        // The port stays a router port while queries keep arriving on it
+        int64_t slot = mcast_find(st, key);
+        if (slot >= 0) {
+            st->entries[slot].statics.w[port_id / 64] &= ~(1ULL << (port_id % 64));
+        }
+    }
+    spinlock_release(&st->lock);
+    return status;
+}
+
+/**
+ * @brief Apply one IGMPv3 or MLDv2 group record
+ */
+static void mcast_record(mcast_state_t *st, uint64_t key, uint8_t type, uint16_t sources, port_id_t port_id) {
+    switch (type) {
+        case MCAST_MODE_IS_EXCLUDE:
+        case MCAST_CHANGE_TO_EXCLUDE:
+            mcast_join(st, key, port_id);
+            break;
+        case MCAST_MODE_IS_INCLUDE:
+        case MCAST_CHANGE_TO_INCLUDE:
+            if (sources != 0) {
+                mcast_join(st, key, port_id);
+            } else {
+                mcast_leave(st, key, port_id);
+            }
+            break;
+        case MCAST_ALLOW_NEW_SOURCES:
+            if (sources != 0) {
+                mcast_join(st, key, port_id);
+            }
+            break;
+        default:
+            // BLOCK_OLD_SOURCES needs source tracking
+            break;
+    }
+}
+
+/**
+ * @brief Key of an IPv4 group, 0 if it is not snooped
+ */
+static uint64_t mcast_ipv4_key(uint32_t group, vlan_id_t vlan_id) {
+    uint8_t mac[MAC_ADDR_LEN] = {0x01, 0x00, 0x5E, (uint8_t)((group >> 16) & 0x7F),
+                                 (uint8_t)(group >> 8), (uint8_t)group};
+
+    if ((group >> 28) != 0xE || !mcast_mac_snooped(mac)) {
+        return 0;
+    }
+    return mcast_key(mac, vlan_id);
+}
+
+/**
+ * @brief Key of an IPv6 group, 0 if it is not snooped
+ */
+static uint64_t mcast_ipv6_key(const uint8_t *group, vlan_id_t vlan_id) {
+    uint8_t mac[MAC_ADDR_LEN] = {0x33, 0x33, group[12], group[13], group[14], group[15]};
+
+    // Interface-local and reserved scopes never leave the host
+    if (group[0] != 0xFF || (group[1] & 0x0F) <= 1 || !mcast_mac_snooped(mac)) {
+        return 0;
+    }
+    return mcast_key(mac, vlan_id);
+}
+
+/**
+ * @brief Learn from an IGMP message; the caller holds the lock
+ */
+static mcast_ctrl_t mcast_igmp(mcast_state_t *st, const uint8_t *msg, uint32_t len, vlan_id_t vlan_id,
+                               port_id_t port_id) {
+    uint64_t key;
+
+    if (len < IGMP_MIN_LEN) {
+        return MCAST_CTRL_NONE;
+    }
+
+    switch (msg[0]) {
+        case IGMP_QUERY:
+            st->stats.queries++;
+            mcast_join(st, mcast_router_key(vlan_id), port_id);
+            return MCAST_CTRL_QUERY;
+
+        case IGMP_V1_REPORT:
+        case IGMP_V2_REPORT:
+        case IGMP_V2_LEAVE:
+            st->stats.reports++;
+            key = mcast_ipv4_key(mcast_read_be32(msg + 4), vlan_id);
+            if (key != 0 && msg[0] == IGMP_V2_LEAVE) {
+                mcast_leave(st, key, port_id);
+            } else if (key != 0) {
+                mcast_join(st, key, port_id);
+            }
+            return MCAST_CTRL_REPORT;
+
+        case IGMP_V3_REPORT: {
+            uint32_t records = mcast_read_be16(msg + 6);
+            uint32_t off = IGMP_MIN_LEN;
+
+            st->stats.reports++;
+            for (uint32_t r = 0; r < records && len - off >= IGMP_V3_RECORD_LEN; r++) {
+                const uint8_t *rec = msg + off;
+                uint16_t sources = mcast_read_be16(rec + 2);
+                uint32_t rec_len = IGMP_V3_RECORD_LEN + 4u * sources + 4u * rec[1];
+
+                if (len - off < rec_len) {
+                    break;
+                }
+                key = mcast_ipv4_key(mcast_read_be32(rec + 4), vlan_id);
+                if (key != 0) {
+                    mcast_record(st, key, rec[0], sources, port_id);
+                }
+                off += rec_len;
+            }
+            return MCAST_CTRL_REPORT;
+        }
+
+        default:
+            return MCAST_CTRL_NONE;
+    }
+}
+
+/**
+ * @brief Learn from a MLD message; the caller holds the lock
+ */
+static mcast_ctrl_t mcast_mld(mcast_state_t *st, const uint8_t *msg, uint32_t len, vlan_id_t vlan_id,
+                              port_id_t port_id) {
+    uint64_t key;
+
+    switch (msg[0]) {
+        case MLD_QUERY:
+            st->stats.queries++;
+            mcast_join(st, mcast_router_key(vlan_id), port_id);
+            return MCAST_CTRL_QUERY;
+
+        case MLD_V1_REPORT:
+        case MLD_V1_DONE:
+            if (len < MLD_MIN_LEN) {
+                return MCAST_CTRL_NONE;
+            }
+            st->stats.reports++;
+            key = mcast_ipv6_key(msg + 8, vlan_id);
+            if (key != 0 && msg[0] == MLD_V1_DONE) {
+                mcast_leave(st, key, port_id);
+            } else if (key != 0) {
+                mcast_join(st, key, port_id);
+            }
+            return MCAST_CTRL_REPORT;
+
+        case MLD_V2_REPORT: {
+            uint32_t records;
+            uint32_t off = MLD_V2_REPORT_MIN_LEN;
+
+            if (len < MLD_V2_REPORT_MIN_LEN) {
+                return MCAST_CTRL_NONE;
+            }
+            records = mcast_read_be16(msg + 6);
+            st->stats.reports++;
+            for (uint32_t r = 0; r < records && len - off >= MLD_V2_RECORD_LEN; r++) {
+                const uint8_t *rec = msg + off;
+                uint16_t sources = mcast_read_be16(rec + 2);
+                uint32_t rec_len = MLD_V2_RECORD_LEN + 16u * sources + 4u * rec[1];
+
+                if (len - off < rec_len) {
+                    break;
+                }
+                key = mcast_ipv6_key(rec + 4, vlan_id);
+                if (key != 0) {
+                    mcast_record(st, key, rec[0], sources, port_id);
+                }
+                off += rec_len;
+            }
+            return MCAST_CTRL_REPORT;
+        }
+
+        default:
+            return MCAST_CTRL_NONE;
+    }
+}
+
+/**
+ * @brief Learn from IGMP, MLD and PIM hellos
+ */
+static mcast_ctrl_t mcast_control(mcast_state_t *st, const packet_buffer_t *packet, vlan_id_t vlan_id,
+                                  port_id_t port_id) {
+    const packet_metadata_t *md = &packet->metadata;
+    mcast_ctrl_t ctrl = MCAST_CTRL_NONE;
+
+    if (!packet_parsed_has(packet, PACKET_PARSED_L4) || md->l4_offset >= packet->size) {
+        return MCAST_CTRL_NONE;
+    }
+
+    uint8_t proto = md->l4_proto;
+    bool ipv4 = packet_has_proto(packet, PACKET_PROTO_IPV4);
+    if (!(ipv4 && proto == MCAST_IPPROTO_IGMP) &&
+        !(!ipv4 && proto == MCAST_IPPROTO_ICMPV6) &&
+        proto != MCAST_IPPROTO_PIM) {
+        return MCAST_CTRL_NONE;
+    }
+
+    const uint8_t *msg = packet_l4_header(packet);
+    uint32_t len = packet->size - md->l4_offset;
+    // ICMPv6 other than MLD is not ours
+    if (proto == MCAST_IPPROTO_ICMPV6 && msg[0] != MLD_QUERY && msg[0] != MLD_V1_REPORT &&
+        msg[0] != MLD_V1_DONE && msg[0] != MLD_V2_REPORT) {
+        return MCAST_CTRL_NONE;
+    }
+
+    spinlock_acquire(&st->lock);
+    if (proto == MCAST_IPPROTO_PIM) {
+        if ((msg[0] & 0x0F) == PIM_HELLO) {
+            st->stats.queries++;
+            mcast_join(st, mcast_router_key(vlan_id), port_id);
+        }
+        ctrl = MCAST_CTRL_QUERY;
+    } else if (proto == MCAST_IPPROTO_IGMP) {
+        ctrl = mcast_igmp(st, msg, len, vlan_id, port_id);
+    } else {
+        ctrl = mcast_mld(st, msg, len, vlan_id, port_id);
+    }
+    spinlock_release(&st->lock);
+    return ctrl;
+}
+
+/**
+ * @brief Learn from a frame and choose where a multicast frame goes
+ *
+ * @param packet Frame received
+ * @param vlan_id VLAN of the frame
+ * @param in_port Ingress port or LAG
+ * @param ports Receives the ports the frame goes to
+ * @return bool true if the frame goes to ports only
+ */
+bool mcast_snoop_process(const packet_buffer_t *packet, vlan_id_t vlan_id, port_id_t in_port,
+                         vlan_port_bitmap_t *ports) {
+    mcast_state_t *st = mcast_state();
+    const uint8_t *dst = packet->data;
+
+    if (!st || !__atomic_load_n(&st->initialized, __ATOMIC_ACQUIRE) || (dst[0] & 0x01) == 0 ||
+        vlan_id >= MAX_VLANS || in_port >= CONFIG_MAX_PORTS ||
+        (__atomic_load_n(&st->enabled[vlan_id / 64], __ATOMIC_RELAXED) & (1ULL << (vlan_id % 64))) == 0) {
+        return false;
+    }
+
+    switch (mcast_control(st, packet, vlan_id, in_port)) {
+        case MCAST_CTRL_REPORT:
+            // Other listeners must not suppress their own reports
+            mcast_read(st, 0, mcast_router_key(vlan_id), ports);
+            return true;
+        case MCAST_CTRL_QUERY:
+            return false;
+        default:
+            break;
+    }
+
+    if (!mcast_mac_snooped(dst)) {
+        return false;
+    }
+
+    if (mcast_read(st, mcast_key(dst, vlan_id), mcast_router_key(vlan_id), ports)) {
+        __atomic_fetch_add(&st->stats.forwarded, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+    __atomic_fetch_add(&st->stats.unregistered, 1, __ATOMIC_RELAXED);
+    return !st->config.flood_unregistered;
+}
+
+/**
+ * @brief Run the timers due up to now
+ *
+ * @param now Current time in seconds
+ * @return status_t Status code
+ */
+status_t mcast_snoop_process_timers(uint32_t now) {
+    mcast_state_t *st = mcast_state();
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    spinlock_acquire(&st->lock);
+    __atomic_store_n(&st->current_time, now, __ATOMIC_RELAXED);
+    if ((int32_t)(now - st->wheel_time) > 0) {
+        uint32_t steps = now - st->wheel_time;
+
+        if (steps > MCAST_WHEEL_SLOTS) {
+            steps = MCAST_WHEEL_SLOTS;
+        }
+        // Every slot sees now, so a clock jump runs everything overdue
+        for (uint32_t i = 1; i <= steps; i++) {
+            mcast_wheel_slot_run(st, &st->wheel[(now - steps + i) & (MCAST_WHEEL_SLOTS - 1)], now);
+        }
+        st->wheel_time = now;
+    }
+    spinlock_release(&st->lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the listeners of a group
+ *
+ * @param vlan_id VLAN
+ * @param group Group MAC address
+ * @param ports Receives the ports with listeners
+ * @return status_t Status code
+ */
+status_t mcast_snoop_get_group(vlan_id_t vlan_id, const mac_addr_t *group, vlan_port_bitmap_t *ports) {
+    mcast_state_t *st = mcast_state();
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!group || !ports) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    int64_t slot = mcast_find(st, mcast_key(group->addr, vlan_id));
+    if (slot >= 0) {
+        *ports = st->ports[slot];
+    }
+    spinlock_release(&st->lock);
+    return slot >= 0 ? STATUS_SUCCESS : STATUS_NOT_FOUND;
+}
+
+/**
+ * @brief Get the router ports of a VLAN
+ *
+ * @param vlan_id VLAN
+ * @param ports Receives the router ports
+ * @return status_t Status code
+ */
+status_t mcast_snoop_get_router_ports(vlan_id_t vlan_id, vlan_port_bitmap_t *ports) {
+    mcast_state_t *st = mcast_state();
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!ports || vlan_id < VLAN_ID_MIN || vlan_id > VLAN_ID_MAX) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    int64_t slot = mcast_find(st, mcast_router_key(vlan_id));
+    if (slot >= 0) {
+        *ports = st->ports[slot];
+    } else {
+        memset(ports, 0, sizeof(*ports));
+    }
+    spinlock_release(&st->lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Copy up to max groups of the table
+ *
+ * @param groups Receives the groups
+ * @param max Capacity of groups
+ * @param count Receives the number copied
+ * @return status_t Status code
+ */
+status_t mcast_snoop_get_groups(mcast_snoop_group_t *groups, uint32_t max, uint32_t *count) {
+    mcast_state_t *st = mcast_state();
+    uint32_t n = 0;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if ((!groups && max != 0) || !count) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    for (uint32_t slot = 0; slot < (st->bucket_mask + 1) * MCAST_BUCKET_SLOTS && n < max; slot++) {
+        uint64_t key = st->buckets[slot / MCAST_BUCKET_SLOTS].keys[slot % MCAST_BUCKET_SLOTS];
+        if (key == 0 || mcast_key_is_router(key)) {
+            continue;
+        }
+        groups[n].vlan_id = (vlan_id_t)(key & (MCAST_KEY_VALID - 1));
+        for (int i = 0; i < MAC_ADDR_LEN; i++) {
+            groups[n].group.addr[i] = (uint8_t)(key >> (16 + 8 * (MAC_ADDR_LEN - 1 - i)));
+        }
+        groups[n].ports = st->ports[slot];
+        n++;
+    }
+    spinlock_release(&st->lock);
+
+    *count = n;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Remove a port from every group and router port set
+ *
+ * @param port_id Port or LAG
+ * @return status_t Status code
+ */
+status_t mcast_snoop_flush_port(port_id_t port_id) {
+    mcast_state_t *st = mcast_state();
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (port_id >= CONFIG_MAX_PORTS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    for (uint32_t slot = 0; slot < (st->bucket_mask + 1) * MCAST_BUCKET_SLOTS; slot++) {
+        if (st->buckets[slot / MCAST_BUCKET_SLOTS].keys[slot % MCAST_BUCKET_SLOTS] == 0 ||
+            !bitmap_test(st->ports[slot].w, port_id) ||
+            bitmap_test(st->entries[slot].statics.w, port_id)) {
+            continue;
+        }
+        mcast_entry_t *entry = &st->entries[slot];
+        entry->fresh.w[port_id / 64] &= ~(1ULL << (port_id % 64));
+        entry->leaving.w[port_id / 64] &= ~(1ULL << (port_id % 64));
+        mcast_set_member(st, slot, port_id, false);
+        if (bitmap_empty(st->ports[slot].w, VLAN_PORT_WORDS)) {
+            mcast_remove(st, slot);
+        }
+    }
+    spinlock_release(&st->lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the counters
+ *
+ * @param stats Receives the counters
+ * @return status_t Status code
+ */
+status_t mcast_snoop_get_stats(mcast_snoop_stats_t *stats) {
+    mcast_state_t *st = mcast_state();
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    *stats = st->stats;
+    stats->forwarded = __atomic_load_n(&st->stats.forwarded, __ATOMIC_RELAXED);
+    stats->unregistered = __atomic_load_n(&st->stats.unregistered, __ATOMIC_RELAXED);
+    stats->groups = st->groups;
+    spinlock_release(&st->lock);
+    return STATUS_SUCCESS;
+}
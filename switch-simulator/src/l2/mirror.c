@@ -0,0 +1,612 @@
+/**
+ * @file mirror.c
+ * @brief Implementation of port and VLAN mirroring
+ *
+ * Every port and VLAN has an ingress and an egress word with one bit per
+ * session that mirrors it, so the data path finds the sessions of a frame
+ * with two loads and does nothing more when both are zero. Session
+ * parameters do not change after creation; a session is reachable only
+ * through those bits, which are set after its parameters are written and
+ * cleared, followed by an RCU grace period, before its slot is reused.
+ *
+ * Counters are sharded per thread (stats_shard.h) and so is the sampling
+ * countdown, so mirroring a busy port from many workers shares no cache
+ * line beyond the destination's queue.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/config.h"
+#include "common/logging.h"
+#include "common/threading.h"
+#include "common/rcu.h"
+#include "common/stats_shard.h"
+#include "hal/hw_simulation.h"
+#include "hal/port_types.h"
+#include "l2/vlan.h"
+#include "l2/mirror.h"
+
+#define MIRROR_ETHERTYPE_VLAN   0x8100
+#define MIRROR_VLAN_HLEN        4
+
+/**
+ * @brief Counters of a session, by index in its stats_shard range
+ */
+enum {
+    MIRROR_CTR_MIRRORED = 0,
+    MIRROR_CTR_MIRRORED_BYTES,
+    MIRROR_CTR_SAMPLED_OUT,
+    MIRROR_CTR_DROPPED,
+    MIRROR_CTR_NO_BUFFER,
+    MIRROR_CTR_COUNT
+};
+
+/**
+ * @brief A session slot
+ */
+typedef struct {
+    bool used;                      /**< Slot holds a session */
+    bool deleting;                  /**< Session being deleted, waiting for readers */
+    mirror_session_config_t config; /**< Fixed while any source bit of the slot is set */
+} mirror_session_t;
+
+/**
+ * @brief Mirroring module state
+ */
+static struct {
+    bool initialized;
+    spinlock_t lock;                /**< Serializes configuration */
+    uint32_t handle;                /**< Ingress pipeline stage */
+    uint32_t sources;               /**< Source bits set, over all ports and VLANs */
+    stats_shard_set_t *counters;    /**< MIRROR_CTR_COUNT counters per session */
+    mirror_session_t sessions[CONFIG_MIRROR_MAX_SESSIONS];
+    uint32_t dest_ports[CONFIG_MAX_PORTS];     /**< Sessions sending to each port */
+    uint32_t port_ingress[CONFIG_MAX_PORTS];   /**< Sessions mirroring each port, by direction */
+    uint32_t port_egress[CONFIG_MAX_PORTS];
+    uint32_t vlan_ingress[MAX_VLANS];          /**< Sessions mirroring each VLAN, by direction */
+    uint32_t vlan_egress[MAX_VLANS];
+} g_mirror = {0};
+
+/* Frames each session has seen on this thread since it last mirrored one */
+static THREAD_LOCAL uint32_t t_since_sample[CONFIG_MIRROR_MAX_SESSIONS];
+
+/**
+ * @brief VLAN a frame is classified in
+ *
+ * The pipeline's classification when it has one, the outer tag otherwise.
+ */
+static inline vlan_id_t mirror_frame_vlan(const packet_buffer_t *packet) {
+    if (packet->metadata.vlan != 0 || !packet_parsed_has(packet, PACKET_PARSED_DONE | PACKET_PARSED_L2) ||
+        packet->metadata.vlan_count == 0) {
+        return packet->metadata.vlan;
+    }
+    return (vlan_id_t)(packet->metadata.vlan_tci[0] & 0x0FFF);
+}
+
+/**
+ * @brief Build the copy of a frame a session sends
+ *
+ * The copy references the frame's data. An RSPAN copy gets a header
+ * segment holding the MAC addresses and the RSPAN tag, built in the
+ * segment's headroom, in front of a slice of the frame after its MACs.
+ *
+ * @param packet Frame
+ * @param config Session parameters
+ * @return Copy, or NULL if out of descriptors or the frame is runt
+ */
+static packet_buffer_t *mirror_copy(const packet_buffer_t *packet, const mirror_session_config_t *config) {
+    uint32_t frame_len = packet_chain_length(packet);
+    uint32_t len = frame_len;
+    packet_buffer_t *copy;
+
+    if (config->truncate_length && config->truncate_length < frame_len) {
+        len = config->truncate_length;
+    }
+    if (len < 2 * MAC_ADDR_LEN) {
+        return NULL;
+    }
+
+    if (!config->rspan) {
+        copy = packet_buffer_slice(packet, 0, len);
+        if (!copy) {
+            return NULL;
+        }
+    } else {
+        packet_buffer_t *rest = packet_buffer_slice(packet, 2 * MAC_ADDR_LEN, len - 2 * MAC_ADDR_LEN);
+        uint16_t tci = (uint16_t)(((uint16_t)config->rspan_priority << 13) | config->rspan_vlan);
+        uint8_t *hdr;
+
+        copy = packet_segment_alloc();
+        if (!copy || !rest ||
+            packet_push_header(copy, 2 * MAC_ADDR_LEN + MIRROR_VLAN_HLEN, &hdr) != STATUS_SUCCESS ||
+            packet_peek_data(packet, 0, hdr, 2 * MAC_ADDR_LEN) != STATUS_SUCCESS) {
+            if (copy) {
+                packet_buffer_free(copy);
+            }
+            if (rest) {
+                packet_buffer_free(rest);
+            }
+            return NULL;
+        }
+        hdr[12] = (uint8_t)(MIRROR_ETHERTYPE_VLAN >> 8);
+        hdr[13] = (uint8_t)MIRROR_ETHERTYPE_VLAN;
+        hdr[14] = (uint8_t)(tci >> 8);
+        hdr[15] = (uint8_t)tci;
+        copy->metadata = packet->metadata;
+        copy->metadata.vlan = config->rspan_vlan;
+        copy->metadata.is_tagged = true;
+        packet_chain_append(copy, rest);
+    }
+
+    // The analyzer port may lack the offloads of the mirrored port
+    copy->metadata.port = config->dest_port;
+    copy->metadata.direction = PACKET_DIR_TX;
+    copy->metadata.offload &= (uint16_t)~PACKET_OFFLOAD_TX_MASK;
+    copy->metadata.tso_mss = 0;
+    if (config->rspan || len < frame_len) {
+        packet_invalidate_parse(copy);
+    }
+    return copy;
+}
+
+/**
+ * @brief Mirror a frame to every session in a mask
+ *
+ * Must be called inside an RCU read section.
+ *
+ * @param packet Frame
+ * @param sessions Session bits
+ * @param counters Counters of the calling thread
+ */
+static void mirror_frame(const packet_buffer_t *packet, uint32_t sessions, uint64_t *counters) {
+    while (sessions) {
+        uint32_t id = (uint32_t)__builtin_ctz(sessions);
+        const mirror_session_config_t *config = &g_mirror.sessions[id].config;
+        uint64_t *ctr = counters + (size_t)id * MIRROR_CTR_COUNT;
+        packet_buffer_t *copy;
+        uint32_t len;
+
+        sessions &= sessions - 1;
+
+        if (config->sample_rate > 1 && ++t_since_sample[id] < config->sample_rate) {
+            stats_shard_add(&ctr[MIRROR_CTR_SAMPLED_OUT], 1);
+            continue;
+        }
+        t_since_sample[id] = 0;
+
+        copy = mirror_copy(packet, config);
+        if (!copy) {
+            stats_shard_add(&ctr[MIRROR_CTR_NO_BUFFER], 1);
+            continue;
+        }
+
+        len = packet_chain_length(copy);
+        if (hw_sim_tx_enqueue_burst(config->dest_port, &copy, 1) == 1) {
+            stats_shard_add(&ctr[MIRROR_CTR_MIRRORED], 1);
+            stats_shard_add(&ctr[MIRROR_CTR_MIRRORED_BYTES], len);
+        } else {
+            stats_shard_add(&ctr[MIRROR_CTR_DROPPED], 1);
+            packet_buffer_free(copy);
+        }
+    }
+}
+
+/**
+ * @brief Ingress mirroring stage; forwards every frame
+ */
+static void mirror_ingress_burst(packet_buffer_t **pkts, uint32_t count, packet_result_t *results,
+                                 void *user_data) {
+    uint64_t *counters = NULL;
+    bool locked = false;
+
+    (void)user_data;
+    for (uint32_t i = 0; i < count; i++) {
+        results[i] = PACKET_RESULT_FORWARD;
+    }
+    if (__atomic_load_n(&g_mirror.sources, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        port_id_t port = pkts[i]->metadata.port;
+        vlan_id_t vlan = mirror_frame_vlan(pkts[i]);
+        uint32_t sessions = 0;
+
+        if (port < CONFIG_MAX_PORTS) {
+            sessions = __atomic_load_n(&g_mirror.port_ingress[port], __ATOMIC_ACQUIRE);
+        }
+        if (vlan < MAX_VLANS) {
+            sessions |= __atomic_load_n(&g_mirror.vlan_ingress[vlan], __ATOMIC_ACQUIRE);
+        }
+        if (sessions == 0) {
+            continue;
+        }
+        if (!locked) {
+            if (rcu_read_lock() != STATUS_SUCCESS) {
+                return;
+            }
+            locked = true;
+            counters = stats_shard_local(g_mirror.counters);
+        }
+        mirror_frame(pkts[i], sessions, counters);
+    }
+
+    if (locked) {
+        rcu_read_unlock();
+    }
+}
+
+/**
+ * @brief Mirror frames about to leave a port, where any session asks for it
+ *
+ * @param port_id Physical egress port
+ * @param pkts Frames as they leave
+ * @param count Number of frames
+ */
+void mirror_egress_burst(port_id_t port_id, packet_buffer_t *const *pkts, uint32_t count) {
+    uint64_t *counters = NULL;
+    uint32_t port_sessions;
+    bool locked = false;
+
+    if (__atomic_load_n(&g_mirror.sources, __ATOMIC_RELAXED) == 0 || port_id >= CONFIG_MAX_PORTS ||
+        __atomic_load_n(&g_mirror.dest_ports[port_id], __ATOMIC_RELAXED) != 0) {
+        return;
+    }
+
+    port_sessions = __atomic_load_n(&g_mirror.port_egress[port_id], __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < count; i++) {
+        vlan_id_t vlan = mirror_frame_vlan(pkts[i]);
+        uint32_t sessions = port_sessions;
+
+        if (vlan < MAX_VLANS) {
+            sessions |= __atomic_load_n(&g_mirror.vlan_egress[vlan], __ATOMIC_ACQUIRE);
+        }
+        if (sessions == 0) {
+            continue;
+        }
+        if (!locked) {
+            if (rcu_read_lock() != STATUS_SUCCESS) {
+                return;
+            }
+            locked = true;
+            counters = stats_shard_local(g_mirror.counters);
+        }
+        mirror_frame(pkts[i], sessions, counters);
+    }
+
+    if (locked) {
+        rcu_read_unlock();
+    }
+}
+
+/**
+ * @brief Check a session ID
+ *
+ * Must be called with the configuration lock held.
+ */
+static inline bool mirror_session_valid(uint32_t session_id) {
+    return g_mirror.initialized && session_id < CONFIG_MIRROR_MAX_SESSIONS &&
+           g_mirror.sessions[session_id].used && !g_mirror.sessions[session_id].deleting;
+}
+
+/**
+ * @brief Set or clear a session's bit in a source word
+ *
+ * Must be called with the configuration lock held.
+ *
+ * @param word Source word
+ * @param bit Session bit
+ * @param on New state
+ */
+static void mirror_source_set(uint32_t *word, uint32_t bit, bool on) {
+    uint32_t old = *word;
+    uint32_t next = on ? (old | bit) : (old & ~bit);
+
+    if (next == old) {
+        return;
+    }
+    if (on) {
+        __atomic_fetch_add(&g_mirror.sources, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_sub(&g_mirror.sources, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(word, next, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Clear every source bit of a session
+ *
+ * Must be called with the configuration lock held.
+ */
+static void mirror_session_clear_sources(uint32_t session_id) {
+    uint32_t bit = 1U << session_id;
+
+    for (uint32_t i = 0; i < CONFIG_MAX_PORTS; i++) {
+        mirror_source_set(&g_mirror.port_ingress[i], bit, false);
+        mirror_source_set(&g_mirror.port_egress[i], bit, false);
+    }
+    for (uint32_t i = 0; i < MAX_VLANS; i++) {
+        mirror_source_set(&g_mirror.vlan_ingress[i], bit, false);
+        mirror_source_set(&g_mirror.vlan_egress[i], bit, false);
+    }
+}
+
+/**
+ * @brief Initialize mirroring and register the ingress stage
+ *
+ * @return status_t Status code
+ */
+status_t mirror_init(void) {
+    status_t status;
+
+    if (g_mirror.initialized) {
+        LOG_WARNING(LOG_CATEGORY_L2, "Mirror: Already initialized");
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    status = stats_shard_create((size_t)CONFIG_MIRROR_MAX_SESSIONS * MIRROR_CTR_COUNT, &g_mirror.counters);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Mirror: Failed to create counters");
+        return status;
+    }
+
+    status = packet_register_burst_processor(mirror_ingress_burst, MIRROR_PROCESSOR_PRIORITY, NULL,
+                                             &g_mirror.handle);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Mirror: Failed to register the ingress stage: %d", status);
+        stats_shard_destroy(g_mirror.counters);
+        g_mirror.counters = NULL;
+        return status;
+    }
+    packet_set_processor_name(g_mirror.handle, "mirror");
+
+    spinlock_init(&g_mirror.lock);
+    __atomic_store_n(&g_mirror.initialized, true, __ATOMIC_RELEASE);
+
+    LOG_INFO(LOG_CATEGORY_L2, "Mirror: Module initialized");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Delete every session and unregister the ingress stage
+ *
+ * @return status_t Status code
+ */
+status_t mirror_cleanup(void) {
+    if (!g_mirror.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    packet_unregister_processor(g_mirror.handle);
+    __atomic_store_n(&g_mirror.initialized, false, __ATOMIC_RELEASE);
+    for (uint32_t id = 0; id < CONFIG_MIRROR_MAX_SESSIONS; id++) {
+        if (g_mirror.sessions[id].used) {
+            mirror_session_clear_sources(id);
+        }
+        g_mirror.sessions[id].used = false;
+        g_mirror.sessions[id].deleting = false;
+    }
+    memset(g_mirror.dest_ports, 0, sizeof(g_mirror.dest_ports));
+    rcu_synchronize();
+    stats_shard_destroy(g_mirror.counters);
+    g_mirror.counters = NULL;
+
+    LOG_INFO(LOG_CATEGORY_L2, "Mirror: Module cleaned up");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Create a mirror session without sources
+ *
+ * @param config Session parameters
+ * @param session_id Session
+ * @return status_t Status code
+ */
+status_t mirror_session_create(const mirror_session_config_t *config, uint32_t *session_id) {
+    port_id_t dest;
+    uint32_t id;
+
+    if (!config || !session_id) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    dest = config->dest_port;
+    if (dest >= CONFIG_LAG_PORT_BASE ||
+        (config->truncate_length && config->truncate_length < MIRROR_TRUNCATE_MIN) ||
+        (config->rspan && (config->rspan_vlan == 0 || config->rspan_vlan > VLAN_ID_MAX ||
+                           config->rspan_priority > 7))) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Mirror: Invalid session to port %d", dest);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_mirror.lock);
+    if (!g_mirror.initialized) {
+        spinlock_release(&g_mirror.lock);
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (g_mirror.port_ingress[dest] || g_mirror.port_egress[dest]) {
+        spinlock_release(&g_mirror.lock);
+        LOG_ERROR(LOG_CATEGORY_L2, "Mirror: Port %d is a mirror source", dest);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    for (id = 0; id < CONFIG_MIRROR_MAX_SESSIONS && g_mirror.sessions[id].used; id++) {
+    }
+    if (id == CONFIG_MIRROR_MAX_SESSIONS) {
+        spinlock_release(&g_mirror.lock);
+        return STATUS_RESOURCE_EXHAUSTED;
+    }
+
+    // No source bit refers to the slot yet, so nothing reads it
+    g_mirror.sessions[id].config = *config;
+    g_mirror.sessions[id].used = true;
+    stats_shard_clear(g_mirror.counters, (size_t)id * MIRROR_CTR_COUNT, MIRROR_CTR_COUNT);
+    __atomic_store_n(&g_mirror.dest_ports[dest], g_mirror.dest_ports[dest] | (1U << id), __ATOMIC_RELAXED);
+    spinlock_release(&g_mirror.lock);
+
+    *session_id = id;
+    LOG_INFO(LOG_CATEGORY_L2, "Mirror: Session %u to port %d%s", id, dest, config->rspan ? " (RSPAN)" : "");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Delete a mirror session and stop mirroring its sources
+ *
+ * @param session_id Session
+ * @return status_t Status code
+ */
+status_t mirror_session_destroy(uint32_t session_id) {
+    port_id_t dest;
+
+    spinlock_acquire(&g_mirror.lock);
+    if (!mirror_session_valid(session_id)) {
+        spinlock_release(&g_mirror.lock);
+        return STATUS_NOT_FOUND;
+    }
+
+    g_mirror.sessions[session_id].deleting = true;
+    mirror_session_clear_sources(session_id);
+    dest = g_mirror.sessions[session_id].config.dest_port;
+    __atomic_store_n(&g_mirror.dest_ports[dest], g_mirror.dest_ports[dest] & ~(1U << session_id),
+                     __ATOMIC_RELAXED);
+    spinlock_release(&g_mirror.lock);
+
+    // Copies in progress may still read the parameters
+    rcu_synchronize();
+
+    spinlock_acquire(&g_mirror.lock);
+    g_mirror.sessions[session_id].used = false;
+    g_mirror.sessions[session_id].deleting = false;
+    spinlock_release(&g_mirror.lock);
+
+    LOG_INFO(LOG_CATEGORY_L2, "Mirror: Session %u deleted", session_id);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Set the directions a port is mirrored in by a session
+ *
+ * @param session_id Session
+ * @param port_id Source port
+ * @param direction MIRROR_DIR_* flags
+ * @return status_t Status code
+ */
+status_t mirror_session_set_port(uint32_t session_id, port_id_t port_id, mirror_direction_t direction) {
+    uint32_t bit = 1U << (session_id & 31);
+
+    if (port_id >= CONFIG_LAG_PORT_BASE || ((uint32_t)direction & ~(uint32_t)MIRROR_DIR_BOTH)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_mirror.lock);
+    if (!mirror_session_valid(session_id)) {
+        spinlock_release(&g_mirror.lock);
+        return STATUS_NOT_FOUND;
+    }
+    if (direction != MIRROR_DIR_NONE && g_mirror.dest_ports[port_id]) {
+        spinlock_release(&g_mirror.lock);
+        LOG_ERROR(LOG_CATEGORY_L2, "Mirror: Port %d is a mirror destination", port_id);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    mirror_source_set(&g_mirror.port_ingress[port_id], bit, (direction & MIRROR_DIR_INGRESS) != 0);
+    mirror_source_set(&g_mirror.port_egress[port_id], bit, (direction & MIRROR_DIR_EGRESS) != 0);
+    spinlock_release(&g_mirror.lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Set the directions a VLAN is mirrored in by a session
+ *
+ * @param session_id Session
+ * @param vlan_id Source VLAN
+ * @param direction MIRROR_DIR_* flags
+ * @return status_t Status code
+ */
+status_t mirror_session_set_vlan(uint32_t session_id, vlan_id_t vlan_id, mirror_direction_t direction) {
+    uint32_t bit = 1U << (session_id & 31);
+
+    if (vlan_id == 0 || vlan_id > VLAN_ID_MAX || ((uint32_t)direction & ~(uint32_t)MIRROR_DIR_BOTH)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_mirror.lock);
+    if (!mirror_session_valid(session_id)) {
+        spinlock_release(&g_mirror.lock);
+        return STATUS_NOT_FOUND;
+    }
+    mirror_source_set(&g_mirror.vlan_ingress[vlan_id], bit, (direction & MIRROR_DIR_INGRESS) != 0);
+    mirror_source_set(&g_mirror.vlan_egress[vlan_id], bit, (direction & MIRROR_DIR_EGRESS) != 0);
+    spinlock_release(&g_mirror.lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the parameters of a session
+ *
+ * @param session_id Session
+ * @param config Parameters
+ * @return status_t Status code
+ */
+status_t mirror_session_get_config(uint32_t session_id, mirror_session_config_t *config) {
+    if (!config) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_mirror.lock);
+    if (!mirror_session_valid(session_id)) {
+        spinlock_release(&g_mirror.lock);
+        return STATUS_NOT_FOUND;
+    }
+    *config = g_mirror.sessions[session_id].config;
+    spinlock_release(&g_mirror.lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the counters of a session
+ *
+ * @param session_id Session
+ * @param stats Counters
+ * @return status_t Status code
+ */
+status_t mirror_session_get_stats(uint32_t session_id, mirror_session_stats_t *stats) {
+    uint64_t counts[MIRROR_CTR_COUNT];
+
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_mirror.lock);
+    if (!mirror_session_valid(session_id)) {
+        spinlock_release(&g_mirror.lock);
+        return STATUS_NOT_FOUND;
+    }
+    stats_shard_fold(g_mirror.counters, (size_t)session_id * MIRROR_CTR_COUNT, MIRROR_CTR_COUNT, counts);
+    spinlock_release(&g_mirror.lock);
+
+    stats->mirrored = counts[MIRROR_CTR_MIRRORED];
+    stats->mirrored_bytes = counts[MIRROR_CTR_MIRRORED_BYTES];
+    stats->sampled_out = counts[MIRROR_CTR_SAMPLED_OUT];
+    stats->dropped = counts[MIRROR_CTR_DROPPED];
+    stats->no_buffer = counts[MIRROR_CTR_NO_BUFFER];
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Clear the counters of a session
+ *
+ * @param session_id Session
+ * @return status_t Status code
+ */
+status_t mirror_session_clear_stats(uint32_t session_id) {
+    spinlock_acquire(&g_mirror.lock);
+    if (!mirror_session_valid(session_id)) {
+        spinlock_release(&g_mirror.lock);
+        return STATUS_NOT_FOUND;
+    }
+    stats_shard_clear(g_mirror.counters, (size_t)session_id * MIRROR_CTR_COUNT, MIRROR_CTR_COUNT);
+    spinlock_release(&g_mirror.lock);
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,480 @@
+/**
+ * @file storm_control.c
+ * @brief Implementation of flood storm control
+ *
+ * A token bucket of rate r and depth B is tracked as its theoretical
+ * arrival time (TAT, the generic cell rate algorithm): a frame costing
+ * c tokens conforms at time t if max(TAT, t) + c / r - t <= B / r, and
+ * then advances TAT to max(TAT, t) + c / r. That leaves one 64-bit word
+ * to update per bucket, which a compare-and-swap does without a lock.
+ * Configuration is written under a spinlock; readers may see a limit
+ * change take effect one frame late, which is harmless for policing.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/config.h"
+#include "common/logging.h"
+#include "common/threading.h"
+#include "common/sim_numa.h"
+#include "hal/packet_drop.h"
+#include "l2/vlan.h"
+#include "l2/storm_control.h"
+
+#define STORM_NS_PER_SEC 1000000000ULL
+
+/**
+ * @brief Highest accepted rate, keeps the bucket arithmetic in 64 bits
+ */
+#define STORM_MAX_RATE 1000000000000ULL
+
+/**
+ * @brief One token bucket
+ */
+typedef struct {
+    uint64_t tat;                   /**< Theoretical arrival time (ns), updated by CAS */
+    uint64_t rate;                  /**< Tokens per second, 0 if disabled */
+    uint64_t depth_ns;              /**< Bucket depth expressed as time at rate */
+} storm_bucket_t;
+
+/**
+ * @brief Packet and byte buckets of one traffic class
+ */
+typedef struct {
+    storm_bucket_t packets;
+    storm_bucket_t bytes;
+} storm_policer_t;
+
+/**
+ * @brief Storm control state of one port or VLAN
+ */
+typedef struct __attribute__((aligned(64))) {
+    storm_policer_t policer[STORM_TYPE_COUNT];
+    uint32_t active;                /**< Bit per storm_type_t with any limit set */
+    uint64_t dropped_packets;       /**< Dropped frames, updated atomically */
+    uint64_t dropped_bytes;         /**< Dropped bytes, updated atomically */
+} storm_entity_t;
+
+/** Bytes of the port and VLAN tables */
+#define STORM_PORTS_BYTES (CONFIG_MAX_PORTS * sizeof(storm_entity_t))
+#define STORM_VLANS_BYTES (MAX_VLANS * sizeof(storm_entity_t))
+
+/**
+ * @brief Storm control module state
+ */
+static struct {
+    bool initialized;
+    spinlock_t lock;                /**< Serializes configuration */
+    storm_entity_t *ports;          /**< CONFIG_MAX_PORTS entries */
+    storm_entity_t *vlans;          /**< MAX_VLANS entries */
+} g_storm = {0};
+
+/**
+ * @brief Current monotonic time in nanoseconds
+ */
+static inline uint64_t storm_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * STORM_NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Take tokens from a bucket
+ *
+ * @param bucket Bucket
+ * @param tokens Tokens the frame costs
+ * @param now Current time (ns)
+ * @param[out] cost Time charged, for storm_bucket_refund()
+ * @return true if the frame conforms (tokens taken)
+ */
+static bool storm_bucket_take(storm_bucket_t *bucket, uint64_t tokens, uint64_t now, uint64_t *cost) {
+    uint64_t rate = __atomic_load_n(&bucket->rate, __ATOMIC_RELAXED);
+    uint64_t depth = __atomic_load_n(&bucket->depth_ns, __ATOMIC_RELAXED);
+    uint64_t tat = __atomic_load_n(&bucket->tat, __ATOMIC_RELAXED);
+    uint64_t next;
+
+    *cost = 0;
+    if (rate == 0) {
+        return true;
+    }
+
+    // Rounded up so that the long-term rate never exceeds the limit
+    *cost = (tokens * STORM_NS_PER_SEC + rate - 1) / rate;
+
+    do {
+        next = (tat > now ? tat : now) + *cost;
+        if (next - now > depth) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&bucket->tat, &tat, next, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    return true;
+}
+
+/**
+ * @brief Return tokens taken by storm_bucket_take()
+ *
+ * @param bucket Bucket
+ * @param cost Time charged
+ */
+static void storm_bucket_refund(storm_bucket_t *bucket, uint64_t cost) {
+    uint64_t tat = __atomic_load_n(&bucket->tat, __ATOMIC_RELAXED);
+
+    // A reconfiguration in between resets TAT; never wrap below it
+    while (cost && tat >= cost &&
+           !__atomic_compare_exchange_n(&bucket->tat, &tat, tat - cost, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+ * @brief Charge a frame to a policer
+ *
+ * @param policer Policer of the frame's class
+ * @param bytes Frame length
+ * @param now Current time (ns)
+ * @param[out] costs Time charged to the packet and byte buckets
+ * @return true if both buckets admitted the frame
+ */
+static bool storm_policer_take(storm_policer_t *policer, uint32_t bytes, uint64_t now, uint64_t costs[2]) {
+    if (!storm_bucket_take(&policer->packets, 1, now, &costs[0])) {
+        return false;
+    }
+    if (!storm_bucket_take(&policer->bytes, bytes, now, &costs[1])) {
+        storm_bucket_refund(&policer->packets, costs[0]);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Return the tokens charged by storm_policer_take()
+ */
+static void storm_policer_refund(storm_policer_t *policer, const uint64_t costs[2]) {
+    storm_bucket_refund(&policer->packets, costs[0]);
+    storm_bucket_refund(&policer->bytes, costs[1]);
+}
+
+/**
+ * @brief Program one bucket
+ *
+ * Must be called with the configuration lock held.
+ *
+ * @param bucket Bucket
+ * @param rate Tokens per second, 0 to disable
+ * @param burst Depth in tokens, 0 for one second at rate
+ */
+static void storm_bucket_set(storm_bucket_t *bucket, uint64_t rate, uint64_t burst) {
+    uint64_t depth = 0;
+
+    if (rate) {
+        depth = burst ? burst * STORM_NS_PER_SEC / rate : STORM_NS_PER_SEC;
+    }
+
+    // Disable first so no reader pairs the new rate with the old depth
+    __atomic_store_n(&bucket->rate, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&bucket->depth_ns, depth, __ATOMIC_RELAXED);
+    __atomic_store_n(&bucket->tat, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&bucket->rate, rate, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Program the policer of one traffic class of an entity
+ *
+ * @param entity Port or VLAN state
+ * @param type Traffic class
+ * @param limit Limits, NULL to disable
+ * @return status_t Status code
+ */
+static status_t storm_entity_set(storm_entity_t *entity, storm_type_t type, const storm_limit_t *limit) {
+    storm_policer_t *policer = &entity->policer[type];
+    uint32_t active;
+
+    if (limit && (limit->pps > STORM_MAX_RATE || limit->bps > STORM_MAX_RATE)) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    storm_bucket_set(&policer->packets, limit ? limit->pps : 0, limit ? limit->burst_packets : 0);
+    storm_bucket_set(&policer->bytes, limit ? limit->bps : 0, limit ? limit->burst_bytes : 0);
+
+    active = __atomic_load_n(&entity->active, __ATOMIC_RELAXED);
+    if (limit && (limit->pps || limit->bps)) {
+        active |= 1U << type;
+    } else {
+        active &= ~(1U << type);
+    }
+    __atomic_store_n(&entity->active, active, __ATOMIC_RELEASE);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Add a drop to an entity's counters
+ */
+static inline void storm_entity_count_drop(storm_entity_t *entity, uint32_t bytes) {
+    __atomic_fetch_add(&entity->dropped_packets, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entity->dropped_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Read an entity's drop counters
+ */
+static void storm_entity_get_counters(const storm_entity_t *entity, storm_counters_t *counters) {
+    counters->dropped_packets = __atomic_load_n(&entity->dropped_packets, __ATOMIC_RELAXED);
+    counters->dropped_bytes = __atomic_load_n(&entity->dropped_bytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Initialize storm control with every limit disabled
+ *
+ * @return status_t Status code
+ */
+status_t storm_control_init(void) {
+    if (g_storm.initialized) {
+        LOG_WARNING(LOG_CATEGORY_L2, "Storm control: Already initialized");
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    // Whole zero pages, touched only as limits are configured
+    uint32_t node = sim_numa_current_node();
+    g_storm.ports = (storm_entity_t *)sim_numa_alloc(STORM_PORTS_BYTES, node);
+    g_storm.vlans = (storm_entity_t *)sim_numa_alloc(STORM_VLANS_BYTES, node);
+    if (!g_storm.ports || !g_storm.vlans) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Storm control: Failed to allocate policers");
+        sim_numa_free(g_storm.ports, STORM_PORTS_BYTES);
+        sim_numa_free(g_storm.vlans, STORM_VLANS_BYTES);
+        g_storm.ports = NULL;
+        g_storm.vlans = NULL;
+        return STATUS_NO_MEMORY;
+    }
+
+    spinlock_init(&g_storm.lock);
+    __atomic_store_n(&g_storm.initialized, true, __ATOMIC_RELEASE);
+
+    LOG_INFO(LOG_CATEGORY_L2, "Storm control: Module initialized");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Free storm control state
+ *
+ * @return status_t Status code
+ */
+status_t storm_control_cleanup(void) {
+    if (!g_storm.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    __atomic_store_n(&g_storm.initialized, false, __ATOMIC_RELEASE);
+    sim_numa_free(g_storm.ports, STORM_PORTS_BYTES);
+    sim_numa_free(g_storm.vlans, STORM_VLANS_BYTES);
+    g_storm.ports = NULL;
+    g_storm.vlans = NULL;
+
+    LOG_INFO(LOG_CATEGORY_L2, "Storm control: Module cleaned up");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Set the limit of a traffic class on an ingress port
+ *
+ * @param port_id Ingress port
+ * @param type Traffic class
+ * @param limit Limits, NULL to disable
+ * @return status_t Status code
+ */
+status_t storm_control_set_port(port_id_t port_id, storm_type_t type, const storm_limit_t *limit) {
+    status_t status;
+
+    if (!g_storm.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Storm control: Module not initialized");
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    if (port_id >= CONFIG_MAX_PORTS || (unsigned)type >= STORM_TYPE_COUNT) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Storm control: Invalid port %d or type %d", port_id, type);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_storm.lock);
+    status = storm_entity_set(&g_storm.ports[port_id], type, limit);
+    spinlock_release(&g_storm.lock);
+
+    if (status == STATUS_SUCCESS) {
+        LOG_INFO(LOG_CATEGORY_L2, "Storm control: Port %d type %d limit %llu pps, %llu Bps", port_id, type,
+                 limit ? (unsigned long long)limit->pps : 0ULL, limit ? (unsigned long long)limit->bps : 0ULL);
+    }
+    return status;
+}
+
+/**
+ * @brief Set the limit of a traffic class in a VLAN
+ *
+ * @param vlan_id VLAN ID
+ * @param type Traffic class
+ * @param limit Limits, NULL to disable
+ * @return status_t Status code
+ */
+status_t storm_control_set_vlan(vlan_id_t vlan_id, storm_type_t type, const storm_limit_t *limit) {
+    status_t status;
+
+    if (!g_storm.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Storm control: Module not initialized");
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    if (vlan_id < VLAN_ID_MIN || vlan_id > VLAN_ID_MAX || (unsigned)type >= STORM_TYPE_COUNT) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Storm control: Invalid VLAN %d or type %d", vlan_id, type);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_storm.lock);
+    status = storm_entity_set(&g_storm.vlans[vlan_id], type, limit);
+    spinlock_release(&g_storm.lock);
+
+    if (status == STATUS_SUCCESS) {
+        LOG_INFO(LOG_CATEGORY_L2, "Storm control: VLAN %d type %d limit %llu pps, %llu Bps", vlan_id, type,
+                 limit ? (unsigned long long)limit->pps : 0ULL, limit ? (unsigned long long)limit->bps : 0ULL);
+    }
+    return status;
+}
+
+/**
+ * @brief Classify a frame that is about to be flooded
+ *
+ * @param packet Frame
+ * @return storm_type_t Traffic class
+ */
+storm_type_t storm_control_classify(const packet_buffer_t *packet) {
+    static const uint8_t broadcast[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+    if (packet->size < 6 || !(packet->data[0] & 0x01)) {
+        return STORM_TYPE_UNKNOWN_UNICAST;
+    }
+    return memcmp(packet->data, broadcast, 6) == 0 ? STORM_TYPE_BROADCAST : STORM_TYPE_MULTICAST;
+}
+
+/**
+ * @brief Police a frame before it is flooded
+ *
+ * @param in_port Ingress port, or PORT_ID_INVALID
+ * @param vlan_id VLAN the frame is flooded in
+ * @param packet Frame
+ * @return bool True if the frame may be flooded
+ */
+bool storm_control_admit(port_id_t in_port, vlan_id_t vlan_id, packet_buffer_t *packet) {
+    storm_entity_t *port = NULL;
+    storm_entity_t *vlan = NULL;
+    uint64_t port_costs[2] = { 0, 0 };
+    uint64_t vlan_costs[2];
+    storm_type_t type;
+    uint64_t now;
+
+    if (!__atomic_load_n(&g_storm.initialized, __ATOMIC_ACQUIRE) || !packet) {
+        return true;
+    }
+
+    type = storm_control_classify(packet);
+    if (in_port < CONFIG_MAX_PORTS &&
+        (__atomic_load_n(&g_storm.ports[in_port].active, __ATOMIC_ACQUIRE) & (1U << type))) {
+        port = &g_storm.ports[in_port];
+    }
+    if (vlan_id < MAX_VLANS &&
+        (__atomic_load_n(&g_storm.vlans[vlan_id].active, __ATOMIC_ACQUIRE) & (1U << type))) {
+        vlan = &g_storm.vlans[vlan_id];
+    }
+
+    // Common case: nothing configured, no clock read
+    if (!port && !vlan) {
+        return true;
+    }
+
+    now = storm_now_ns();
+
+    if (port && !storm_policer_take(&port->policer[type], packet->size, now, port_costs)) {
+        storm_entity_count_drop(port, packet->size);
+        if (vlan_id < MAX_VLANS) {
+            storm_entity_count_drop(&g_storm.vlans[vlan_id], packet->size);
+        }
+        packet_drop_count(packet, PACKET_DROP_STORM_CONTROL);
+        return false;
+    }
+
+    if (vlan && !storm_policer_take(&vlan->policer[type], packet->size, now, vlan_costs)) {
+        if (port) {
+            storm_policer_refund(&port->policer[type], port_costs);
+            storm_entity_count_drop(port, packet->size);
+        } else if (in_port < CONFIG_MAX_PORTS) {
+            storm_entity_count_drop(&g_storm.ports[in_port], packet->size);
+        }
+        storm_entity_count_drop(vlan, packet->size);
+        packet_drop_count(packet, PACKET_DROP_STORM_CONTROL);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Get the storm control drop counters of a VLAN
+ *
+ * @param vlan_id VLAN ID
+ * @param counters Output drop counters
+ * @return status_t Status code
+ */
+status_t storm_control_get_vlan_counters(vlan_id_t vlan_id, storm_counters_t *counters) {
+    if (!counters || vlan_id >= MAX_VLANS) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (!g_storm.initialized) {
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    storm_entity_get_counters(&g_storm.vlans[vlan_id], counters);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the storm control drop counters of an ingress port
+ *
+ * @param port_id Port ID
+ * @param counters Output drop counters
+ * @return status_t Status code
+ */
+status_t storm_control_get_port_counters(port_id_t port_id, storm_counters_t *counters) {
+    if (!counters || port_id >= CONFIG_MAX_PORTS) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (!g_storm.initialized) {
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    storm_entity_get_counters(&g_storm.ports[port_id], counters);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Clear the storm control drop counters of a VLAN
+ *
+ * @param vlan_id VLAN ID
+ * @return status_t Status code
+ */
+status_t storm_control_clear_vlan_counters(vlan_id_t vlan_id) {
+    if (vlan_id >= MAX_VLANS) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (!g_storm.initialized) {
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    __atomic_store_n(&g_storm.vlans[vlan_id].dropped_packets, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_storm.vlans[vlan_id].dropped_bytes, 0, __ATOMIC_RELAXED);
+    return STATUS_SUCCESS;
+}
@@ -8,12 +8,18 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include "common/types.h"
 #include "common/error_codes.h"
 #include "common/logging.h"
 #include "common/threading.h"
+#include "common/event_feed.h"
+#include "common/event_loop.h"
+#include "common/trace.h"
+#include "common/bitmap.h"
 #include "hal/port.h"
 #include "hal/packet.h"
+#include "hal/link_event.h"
 #include "l2/stp.h"
 #include "l2/vlan.h"
 
@@ -38,12 +44,48 @@ typedef packet_buffer_t packet_t;
 #define STP_HELLO_TIMER 2
 #define STP_TCN_TIMER 1
 
+#define STP_USEC_PER_SEC 1000000ULL
+
+/**
+ * @brief Per-instance port states, 2 bits each
+ *
+ * MSTP instances only distinguish discarding, learning and forwarding.
+ * The CIST keeps its full 802.1D state in stp_port_info_t::state as well.
+ */
+#define STP_INSTANCE_DISCARDING 0
+#define STP_INSTANCE_LEARNING 1
+#define STP_INSTANCE_FORWARDING 2
+#define STP_INSTANCE_STATE_MASK 3ULL
+
+#define STP_INSTANCE_COUNT (STP_MAX_MSTI + 1)
+#define STP_INSTANCES_PER_WORD 32
+#define STP_INSTANCE_WORDS ((STP_INSTANCE_COUNT + STP_INSTANCES_PER_WORD - 1) / STP_INSTANCES_PER_WORD)
+
 #define STP_BPDU_CONFIG 0x00
+#define STP_BPDU_RST 0x02       // RST/MST BPDU, carries the CIST like a config BPDU
 #define STP_BPDU_TCN 0x80
 
+#define STP_VERSION_MST 3
+#define STP_MST_MAX_HOPS 20
+#define STP_MST_CONFIG_NAME_LEN 32
+#define STP_MST_MSTI_OFFSET 119  // First MSTI configuration message in an MST BPDU
+#define STP_MST_MSTI_MSG_LEN 16
+#define STP_BPDU_MAX_SIZE (STP_MST_MSTI_OFFSET + STP_MAX_MSTI * STP_MST_MSTI_MSG_LEN)
+
 #define STP_FLAG_TC 0x01        // Topology Change flag
+#define STP_FLAG_PROPOSAL 0x02  // RSTP proposal
+#define STP_FLAG_ROLE_SHIFT 2   // RSTP port role, two bits
+#define STP_FLAG_LEARNING 0x10  // RSTP learning
+#define STP_FLAG_FORWARDING 0x20 // RSTP forwarding
+#define STP_FLAG_AGREEMENT 0x40 // RSTP agreement
 #define STP_FLAG_TCA 0x80       // Topology Change Acknowledgment flag
 
+#define STP_BPDU_ROLE_ALTERNATE 1
+#define STP_BPDU_ROLE_ROOT 2
+#define STP_BPDU_ROLE_DESIGNATED 3
+
+#define STP_VERSION_RST 2
+
 typedef struct {
     port_id_t port_id;             // Port ID
     stp_port_state_t state;        // Port state (disabled, blocking, listening, learning, forwarding)
@@ -59,21 +101,22 @@ typedef struct {
     uint32_t forward_delay;        // Forward delay
     bool topology_change;          // Topology change flag
     bool topology_change_ack;      // Topology change acknowledgment flag
-    uint32_t timer_hello;          // Hello timer
-    uint32_t timer_tcn;            // Topology change notification timer
-    uint32_t timer_forward_delay;  // Forward delay timer
-    uint32_t timer_message_age;    // Message age timer
+    event_timer_t tcn_timer;           // Topology change notification timer
+    event_timer_t forward_delay_timer; // Forward delay timer
+    event_timer_t message_age_timer;   // Message age timer, re-armed by every BPDU
     bool bpdu_received;            // Whether BPDU received on this port
-    // Информация, специфичная для VLAN
-    struct stp_vlan_info {
-        stp_port_state_t state;    // State for this VLAN
-    // Другие поля, которые могут различаться для разных VLAN
-    } *vlans;                      // Массив состояний для разных VLAN
-    uint16_t vlans_allocated;      // Количество выделенной памяти для VLAN
+    uint64_t instance_state[STP_INSTANCE_WORDS]; // 2-bit states of the CIST and all MSTIs
+    stp_port_role_t role;          // Port role
+    bool edge;                     // Configured as an edge port
+    bool oper_edge;                // Edge port that has not seen a BPDU since link up
+    bool proposing;                // Designated port waiting for an RSTP agreement
+    packet_buffer_t bpdu_packet;   // Cached config BPDU, data points into the bridge's templates
+    uint32_t bpdu_generation;      // Template is current if equal to the bridge's generation
 } stp_port_info_t;
 
 typedef struct {
     bool enabled;                  // STP enabled flag
+    stp_version_t version;         // Protocol version, RSTP and MSTP converge rapidly
     bridge_id_t bridge_id;         // Bridge ID (priority + MAC)
     bridge_id_t root_id;           // Root bridge ID
     uint32_t root_path_cost;       // Root path cost
@@ -82,14 +125,29 @@ typedef struct {
     uint32_t hello_time;           // Hello time
     uint32_t forward_delay;        // Forward delay
     bool topology_change;          // Topology change flag
-    uint32_t topology_change_time; // Topology change time
-    uint32_t timer_hello;          // Hello timer
-    uint32_t timer_topology_change; // Topology change timer
+    uint32_t topology_change_time; // Topology change period in seconds
+    event_timer_t hello_timer;     // Hello timer
+    event_timer_t topology_change_timer; // Topology change timer
     uint32_t ports_count;          // Number of ports
     stp_port_info_t *ports;        // Array of port info
+    uint8_t vlan_instance[MAX_VLANS]; // VLAN to MSTI map, STP_CIST_ID if unmapped
+    uint16_t instance_vlans[STP_INSTANCE_COUNT]; // Number of VLANs mapped to each MSTI
+    uint8_t *bpdu_templates;       // STP_BPDU_MAX_SIZE bytes per port
+    uint32_t bpdu_generation;      // Bumped whenever the bridge or root vector changes
+    port_id_t *hello_burst;        // Ports sent to by the current hello
     spinlock_t lock;               // Lock for thread-safe access
 } stp_bridge_info_t;
 
+/**
+ * @brief Spanning tree priority vector, compared field by field (lower is better)
+ */
+typedef struct {
+    bridge_id_t root_id;           // Root bridge ID
+    uint32_t root_path_cost;       // Root path cost
+    bridge_id_t bridge_id;         // Designated bridge ID
+    port_id_t port_id;             // Designated port ID
+} stp_vector_t;
+
 static stp_bridge_info_t g_stp_bridge;
 
 static inline void stp_acquire_lock(void) {
@@ -100,6 +158,82 @@ static inline void stp_release_lock(void) {
       spinlock_release(&g_stp_bridge.lock);
 }
 
+/**
+ * @brief Mark every port's cached BPDU stale
+ *
+ * For changes to the fields shared by all ports: root and bridge IDs,
+ * root path cost, timers and the set of active MSTIs.
+ */
+static void stp_invalidate_bpdus(void) {
+    g_stp_bridge.bpdu_generation++;
+}
+
+static void stp_port_invalidate_bpdu(stp_port_info_t *port) {
+    port->bpdu_generation = g_stp_bridge.bpdu_generation - 1;
+}
+
+static uint64_t stp_instance_pack_state(stp_port_state_t state) {
+    switch (state) {
+    case STP_PORT_STATE_LEARNING:
+        return STP_INSTANCE_LEARNING;
+    case STP_PORT_STATE_FORWARDING:
+        return STP_INSTANCE_FORWARDING;
+    default:
+        return STP_INSTANCE_DISCARDING;
+    }
+}
+
+static stp_port_state_t stp_instance_unpack_state(uint64_t bits) {
+    switch (bits) {
+    case STP_INSTANCE_LEARNING:
+        return STP_PORT_STATE_LEARNING;
+    case STP_INSTANCE_FORWARDING:
+        return STP_PORT_STATE_FORWARDING;
+    default:
+        return STP_PORT_STATE_BLOCKING;
+    }
+}
+
+static uint64_t stp_port_instance_bits(const stp_port_info_t *port, uint32_t instance) {
+    uint64_t word = __atomic_load_n(&port->instance_state[instance / STP_INSTANCES_PER_WORD],
+                                    __ATOMIC_RELAXED);
+    return (word >> ((instance % STP_INSTANCES_PER_WORD) * 2)) & STP_INSTANCE_STATE_MASK;
+}
+
+/**
+ * @brief Set a port's state in one instance; caller holds the STP lock
+ *
+ * The word is published with a single store for lockless stp_can_forward().
+ */
+static void stp_port_set_instance_bits(stp_port_info_t *port, uint32_t instance, stp_port_state_t state) {
+    uint64_t *word = &port->instance_state[instance / STP_INSTANCES_PER_WORD];
+    uint32_t shift = (instance % STP_INSTANCES_PER_WORD) * 2;
+    uint64_t value = (*word & ~(STP_INSTANCE_STATE_MASK << shift)) |
+                     (stp_instance_pack_state(state) << shift);
+
+    __atomic_store_n(word, value, __ATOMIC_RELEASE);
+
+    // MSTI states are carried in the port's BPDU
+    if (instance != STP_CIST_ID) {
+        stp_port_invalidate_bpdu(port);
+    }
+}
+
+/**
+ * @brief Change a port's STP state and mirror it into the VLAN flood masks
+ */
+static void stp_port_set_state(stp_port_info_t *port, stp_port_state_t state) {
+   if (port->state != state) {
+       TRACE_POINT(TRACE_STP_STATE, port->port_id, port->state, state);
+   }
+   port->state = state;
+   port->proposing = port->proposing &&
+                     (state == STP_PORT_STATE_LISTENING || state == STP_PORT_STATE_LEARNING);
+   stp_port_set_instance_bits(port, STP_CIST_ID, state);
+   (void)vlan_set_port_forwarding(port->port_id,
+                                  !g_stp_bridge.enabled || state == STP_PORT_STATE_FORWARDING);
+}
+
 static int compare_bridge_id(bridge_id_t id1, bridge_id_t id2) {
     // Compare bridge priorities first (lower is better)
     if (id1.priority < id2.priority) {
@@ -112,6 +246,107 @@ static int compare_bridge_id(bridge_id_t id1, bridge_id_t id2) {
     return memcmp(id1.mac_address.addr, id2.mac_address.addr, MAC_ADDR_LEN);
 }
 
+/**
+ * @brief Append the MSTP part of an MST BPDU after the CIST fields
+ *
+ * One BPDU carries a configuration message for every MSTI that has VLANs
+ * mapped to it, so the BPDU count per port does not grow with the VLANs.
+ *
+ * @return Total BPDU length
+ */
+static uint32_t generate_mst_fields(const stp_port_info_t *port, uint8_t flags, uint8_t *data) {
+    // MST configuration identifier: format selector, name, revision, digest
+    char name[STP_MST_CONFIG_NAME_LEN + 1];
+    const uint8_t *mac = g_stp_bridge.bridge_id.mac_address.addr;
+
+    memset(&data[52], 0, STP_MST_MSTI_OFFSET - 52);
+    snprintf(name, sizeof(name), "%02x:%02x:%02x:%02x:%02x:%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    memcpy(&data[56], name, strlen(name));
+    // The configuration digest is left zero: regions are not configurable yet
+
+    // CIST internal root path cost stays 0, CIST bridge ID is ours
+    data[110] = (g_stp_bridge.bridge_id.priority >> 8) & 0xFF;
+    data[111] = g_stp_bridge.bridge_id.priority & 0xFF;
+    memcpy(&data[112], mac, MAC_ADDR_LEN);
+    data[118] = STP_MST_MAX_HOPS;
+
+    uint32_t offset = STP_MST_MSTI_OFFSET;
+    for (uint32_t msti = 1; msti < STP_INSTANCE_COUNT; msti++) {
+        if (g_stp_bridge.instance_vlans[msti] == 0) {
+            continue;
+        }
+
+        uint64_t bits = stp_port_instance_bits(port, msti);
+        uint16_t regional_root = (g_stp_bridge.bridge_id.priority & 0xF000) | msti;
+        uint8_t *msg = &data[offset];
+
+        msg[0] = (flags & STP_FLAG_TC) |
+                 (bits != STP_INSTANCE_DISCARDING ? 0x10 : 0) |  // Learning
+                 (bits == STP_INSTANCE_FORWARDING ? 0x20 : 0);   // Forwarding
+        msg[1] = (regional_root >> 8) & 0xFF;
+        msg[2] = regional_root & 0xFF;
+        memcpy(&msg[3], mac, MAC_ADDR_LEN);
+        memset(&msg[9], 0, 4);  // Internal root path cost
+        msg[13] = (g_stp_bridge.bridge_id.priority >> 8) & 0xF0;
+        msg[14] = port->port_priority & 0xF0;
+        msg[15] = STP_MST_MAX_HOPS;
+        offset += STP_MST_MSTI_MSG_LEN;
+    }
+
+    // Version 1 length is 0, version 3 length covers everything after it
+    uint16_t v3_len = offset - 55;
+    data[53] = (v3_len >> 8) & 0xFF;
+    data[54] = v3_len & 0xFF;
+
+    return offset;
+}
+
+static bool stp_is_rapid(void) {
+    return g_stp_bridge.version != STP_VERSION_STP;
+}
+
+/**
+ * @brief Flags byte of a port's config BPDU
+ *
+ * RSTP BPDUs also carry the port role, its state and a pending proposal.
+ */
+static uint8_t stp_port_bpdu_flags(const stp_port_info_t *port) {
+    uint8_t flags = (port->topology_change ? STP_FLAG_TC : 0) |
+                    (port->topology_change_ack ? STP_FLAG_TCA : 0);
+
+    if (!stp_is_rapid()) {
+        return flags;
+    }
+
+    switch (port->role) {
+    case STP_PORT_ROLE_ROOT:
+        flags |= STP_BPDU_ROLE_ROOT << STP_FLAG_ROLE_SHIFT;
+        break;
+    case STP_PORT_ROLE_DESIGNATED:
+        flags |= STP_BPDU_ROLE_DESIGNATED << STP_FLAG_ROLE_SHIFT;
+        break;
+    case STP_PORT_ROLE_ALTERNATE:
+    case STP_PORT_ROLE_BACKUP:
+        flags |= STP_BPDU_ROLE_ALTERNATE << STP_FLAG_ROLE_SHIFT;
+        break;
+    default:
+        break;
+    }
+
+    if (port->state == STP_PORT_STATE_LEARNING || port->state == STP_PORT_STATE_FORWARDING) {
+        flags |= STP_FLAG_LEARNING;
+    }
+    if (port->state == STP_PORT_STATE_FORWARDING) {
+        flags |= STP_FLAG_FORWARDING;
+    }
+    if (port->proposing) {
+        flags |= STP_FLAG_PROPOSAL;
+    }
+
+    return flags;
+}
+
 static status_t generate_bpdu(port_id_t port_id, uint8_t bpdu_type, packet_buffer_t *packet) {
     if (!packet) {
         LOG_ERROR(LOG_CATEGORY_L2, "Invalid packet buffer");
@@ -151,13 +386,7 @@ static status_t generate_bpdu(port_id_t port_id, uint8_t bpdu_type, packet_buffe
     
     if (bpdu_type == STP_BPDU_CONFIG) {
         // Config BPDU fields
-        uint8_t flags = 0;
-        if (port->topology_change) {
-            flags |= STP_FLAG_TC;
-        }
-        if (port->topology_change_ack) {
-            flags |= STP_FLAG_TCA;
-        }
+        uint8_t flags = stp_port_bpdu_flags(port);
         
         packet->data[21] = flags;  // Flags
         
@@ -202,6 +431,28 @@ static status_t generate_bpdu(port_id_t port_id, uint8_t bpdu_type, packet_buffe
         packet->data[51] = forward_delay & 0xFF;
         
         packet->size = 52;  // Total length of config BPDU
+
+        if (stp_is_rapid()) {
+            // RST BPDU: same fields plus a zero version 1 length
+            packet->data[13] = 0x27;
+            packet->data[19] = STP_VERSION_RST;
+            packet->data[20] = STP_BPDU_RST;
+            packet->data[52] = 0;
+            packet->size = 53;
+        }
+
+        // With MSTIs in use every instance rides in one MST BPDU
+        bool mst = false;
+        for (uint32_t msti = 1; msti < STP_INSTANCE_COUNT && !mst; msti++) {
+            mst = g_stp_bridge.instance_vlans[msti] != 0;
+        }
+        if (mst && packet->capacity >= STP_BPDU_MAX_SIZE) {
+            packet->data[19] = STP_VERSION_MST;
+            packet->data[20] = STP_BPDU_RST;
+            packet->size = generate_mst_fields(port, flags, packet->data);
+            packet->data[12] = ((packet->size - 14) >> 8) & 0xFF;
+            packet->data[13] = (packet->size - 14) & 0xFF;
+        }
     } else if (bpdu_type == STP_BPDU_TCN) {
         // TCN BPDU is much simpler
         packet->data[13] = 0x03;  // Length for TCN BPDU (3 bytes)
@@ -211,49 +462,485 @@ static status_t generate_bpdu(port_id_t port_id, uint8_t bpdu_type, packet_buffe
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Send a config BPDU on a port right away
+ *
+ * For the RSTP handshake, which cannot wait for the next hello.
+ *
+ * @param port Port
+ * @param extra_flags Flags to set on top of the port's own, e.g. agreement
+ */
+static void stp_port_send_bpdu(stp_port_info_t *port, uint8_t extra_flags) {
+    uint8_t frame[STP_BPDU_MAX_SIZE];
+    packet_t bpdu_packet = { .data = frame, .capacity = sizeof(frame) };
+
+    if (generate_bpdu(port->port_id, STP_BPDU_CONFIG, &bpdu_packet) == STATUS_SUCCESS) {
+        frame[21] |= extra_flags;
+        packet_transmit(&bpdu_packet, port->port_id);
+    }
+}
+
+static int compare_vector(const stp_vector_t *a, const stp_vector_t *b) {
+    int cmp = compare_bridge_id(a->root_id, b->root_id);
+    if (cmp != 0) {
+        return cmp;
+    }
+
+    if (a->root_path_cost != b->root_path_cost) {
+        return a->root_path_cost < b->root_path_cost ? -1 : 1;
+    }
+
+    cmp = compare_bridge_id(a->bridge_id, b->bridge_id);
+    if (cmp != 0) {
+        return cmp;
+    }
+
+    return (a->port_id > b->port_id) - (a->port_id < b->port_id);
+}
+
+/**
+ * @brief Priority vector last received on a port
+ */
+static stp_vector_t stp_received_vector(const stp_port_info_t *port) {
+    stp_vector_t vector = {
+        port->designated_root, port->root_path_cost, port->designated_bridge, port->designated_port
+    };
+    return vector;
+}
+
+/**
+ * @brief Priority vector this bridge would send on a port
+ */
+static stp_vector_t stp_designated_vector(const stp_port_info_t *port) {
+    stp_vector_t vector = {
+        g_stp_bridge.root_id, g_stp_bridge.root_path_cost, g_stp_bridge.bridge_id,
+        (port_id_t)((port->port_priority << 8) | (port->port_id & 0xFF))
+    };
+    return vector;
+}
+
+/**
+ * @brief Path to the root offered through a port
+ */
+static stp_vector_t stp_root_path_vector(const stp_port_info_t *port) {
+    stp_vector_t vector = stp_received_vector(port);
+    vector.root_path_cost += port->path_cost;
+    return vector;
+}
+
+/**
+ * @brief Check if a port knows of a root better than this bridge
+ */
+static bool stp_port_can_be_root(const stp_port_info_t *port) {
+    return port->bpdu_received && port->state != STP_PORT_STATE_DISABLED &&
+           compare_bridge_id(port->designated_root, g_stp_bridge.bridge_id) < 0;
+}
+
+/**
+ * @brief Arm an STP timer in the event loop's timer wheel
+ *
+ * Without a running event loop the timer is simply not armed.
+ */
+static void stp_timer_start(event_timer_t *timer, uint32_t seconds, bool periodic) {
+    uint64_t delay_us = (uint64_t)seconds * STP_USEC_PER_SEC;
+    (void)event_timer_start(timer, delay_us, periodic ? delay_us : 0);
+}
+
+static void stp_port_stop_timers(stp_port_info_t *port) {
+    (void)event_timer_stop(&port->tcn_timer);
+    (void)event_timer_stop(&port->forward_delay_timer);
+    (void)event_timer_stop(&port->message_age_timer);
+}
+
+static void stp_topology_change_start(void) {
+    g_stp_bridge.topology_change = true;
+    g_stp_bridge.topology_change_time = STP_DEFAULT_FORWARD_DELAY * 2;
+    stp_timer_start(&g_stp_bridge.topology_change_timer, g_stp_bridge.topology_change_time, false);
+}
+
+/**
+ * @brief Move a port straight to forwarding, skipping forward delay
+ */
+static void stp_port_set_forwarding(stp_port_info_t *port) {
+    if (port->state == STP_PORT_STATE_FORWARDING) {
+        return;
+    }
+
+    (void)event_timer_stop(&port->forward_delay_timer);
+    stp_port_set_state(port, STP_PORT_STATE_FORWARDING);
+    LOG_INFO(LOG_CATEGORY_L2, "Port %u rapid transition to forwarding", port->port_id);
+}
+
+/**
+ * @brief Decide the role of one port and start its state transition
+ *
+ * The root port and designated ports leave blocking through listening;
+ * a port whose segment already has a better designated bridge blocks.
+ * With RSTP, edge ports and an alternate port taking over as root port
+ * forward at once, and a designated port proposes to its peer so an
+ * agreement can cut the forward delay short.
+ */
+static void stp_update_port_role(stp_port_info_t *port) {
+    stp_port_role_t old_role = port->role;
+
+    if (port->state == STP_PORT_STATE_DISABLED) {
+        port->role = STP_PORT_ROLE_DISABLED;
+        if (old_role != port->role) {
+            TRACE_POINT(TRACE_STP_ROLE, port->port_id, old_role, port->role);
+            if (event_feed_enabled(EVENT_FEED_STP_ROLE)) {
+                event_feed_post_stp_role(port->port_id, (uint8_t)old_role, (uint8_t)port->role);
+            }
+        }
+        return;
+    }
+
+    if (port->port_id == g_stp_bridge.root_port) {
+        port->role = STP_PORT_ROLE_ROOT;
+    } else if (!port->bpdu_received) {
+        port->role = STP_PORT_ROLE_DESIGNATED;
+    } else {
+        stp_vector_t designated = stp_designated_vector(port);
+        stp_vector_t received = stp_received_vector(port);
+        if (compare_vector(&designated, &received) < 0) {
+            port->role = STP_PORT_ROLE_DESIGNATED;
+        } else if (compare_bridge_id(port->designated_bridge, g_stp_bridge.bridge_id) == 0) {
+            // Another port of this bridge is designated for the segment
+            port->role = STP_PORT_ROLE_BACKUP;
+        } else {
+            port->role = STP_PORT_ROLE_ALTERNATE;
+        }
+    }
+    if (old_role != port->role) {
+        TRACE_POINT(TRACE_STP_ROLE, port->port_id, old_role, port->role);
+        if (event_feed_enabled(EVENT_FEED_STP_ROLE)) {
+            event_feed_post_stp_role(port->port_id, (uint8_t)old_role, (uint8_t)port->role);
+        }
+    }
+
+    if (port->role == STP_PORT_ROLE_ROOT || port->role == STP_PORT_ROLE_DESIGNATED) {
+        if (stp_is_rapid() &&
+            ((port->role == STP_PORT_ROLE_DESIGNATED && port->oper_edge) ||
+             (port->role == STP_PORT_ROLE_ROOT &&
+              (old_role == STP_PORT_ROLE_ALTERNATE || old_role == STP_PORT_ROLE_BACKUP)))) {
+            stp_port_set_forwarding(port);
+        } else if (port->state == STP_PORT_STATE_BLOCKING) {
+            stp_port_set_state(port, STP_PORT_STATE_LISTENING);
+            stp_timer_start(&port->forward_delay_timer, g_stp_bridge.forward_delay, false);
+            LOG_INFO(LOG_CATEGORY_L2, "Port %u transitions from blocking to listening", port->port_id);
+
+            if (stp_is_rapid() && port->role == STP_PORT_ROLE_DESIGNATED) {
+                port->proposing = true;
+                stp_port_send_bpdu(port, 0);
+            }
+        }
+    } else if (port->state != STP_PORT_STATE_BLOCKING) {
+        stp_port_set_state(port, STP_PORT_STATE_BLOCKING);
+        (void)event_timer_stop(&port->forward_delay_timer);
+        LOG_INFO(LOG_CATEGORY_L2, "Port %u transitions to blocking", port->port_id);
+    }
+}
+
+/**
+ * @brief Answer a proposal received on the root port
+ *
+ * Sync: forwarding designated ports that are not edge ports go back to
+ * discarding, where they propose to their own peers. No loop can then
+ * form through this bridge, so the root port forwards at once and the
+ * agreement goes back upstream.
+ */
+static void stp_port_agree(stp_port_info_t *root) {
+    if (root->state != STP_PORT_STATE_FORWARDING) {
+        for (uint32_t i = 0; i < g_stp_bridge.ports_count; i++) {
+            stp_port_info_t *port = &g_stp_bridge.ports[i];
+            // Designated ports still discarding are already proposing
+            if (port != root && port->role == STP_PORT_ROLE_DESIGNATED && !port->oper_edge &&
+                port->state == STP_PORT_STATE_FORWARDING) {
+                stp_port_set_state(port, STP_PORT_STATE_BLOCKING);
+                stp_update_port_role(port);
+            }
+        }
+        stp_port_set_forwarding(root);
+    }
+
+    stp_port_send_bpdu(root, STP_FLAG_AGREEMENT);
+}
+
+/**
+ * @brief Make a port the root port, or this bridge the root
+ *
+ * If the root or the root path cost changes, every port's designated
+ * vector changes with it and all roles are recomputed. A root port move
+ * at equal cost only touches the old and the new root port.
+ *
+ * @param root_port New root port, PORT_ID_INVALID if this bridge is the root
+ */
+static void stp_set_root_port(port_id_t root_port) {
+    port_id_t old_root_port = g_stp_bridge.root_port;
+    bridge_id_t root_id = g_stp_bridge.bridge_id;
+    uint32_t root_path_cost = 0;
+
+    if (root_port < g_stp_bridge.ports_count) {
+        stp_port_info_t *port = &g_stp_bridge.ports[root_port];
+        root_id = port->designated_root;
+        root_path_cost = port->root_path_cost + port->path_cost;
+    } else {
+        root_port = PORT_ID_INVALID;
+    }
+
+    bool root_changed = compare_bridge_id(root_id, g_stp_bridge.root_id) != 0 ||
+                        root_path_cost != g_stp_bridge.root_path_cost;
+
+    g_stp_bridge.root_id = root_id;
+    g_stp_bridge.root_path_cost = root_path_cost;
+    g_stp_bridge.root_port = root_port;
+
+    if (root_changed) {
+        stp_invalidate_bpdus();
+        for (uint32_t i = 0; i < g_stp_bridge.ports_count; i++) {
+            stp_update_port_role(&g_stp_bridge.ports[i]);
+        }
+
+        LOG_INFO(LOG_CATEGORY_L2, "Root bridge ID %04x:%02x:%02x:%02x:%02x:%02x:%02x, cost %u, root port %u",
+                 g_stp_bridge.root_id.priority,
+                 g_stp_bridge.root_id.mac_address.addr[0],
+                 g_stp_bridge.root_id.mac_address.addr[1],
+                 g_stp_bridge.root_id.mac_address.addr[2],
+                 g_stp_bridge.root_id.mac_address.addr[3],
+                 g_stp_bridge.root_id.mac_address.addr[4],
+                 g_stp_bridge.root_id.mac_address.addr[5],
+                 g_stp_bridge.root_path_cost, root_port);
+    } else if (root_port != old_root_port) {
+        if (old_root_port < g_stp_bridge.ports_count) {
+            stp_update_port_role(&g_stp_bridge.ports[old_root_port]);
+        }
+        if (root_port != PORT_ID_INVALID) {
+            stp_update_port_role(&g_stp_bridge.ports[root_port]);
+        }
+    }
+}
+
+/**
+ * @brief Elect the root port over all ports
+ *
+ * Only needed when the root port's offer got worse or went away; a
+ * better offer on any port is picked up by stp_port_info_changed().
+ */
+static void stp_select_root(void) {
+    port_id_t best = PORT_ID_INVALID;
+    stp_vector_t best_vector;
+
+    for (uint32_t i = 0; i < g_stp_bridge.ports_count; i++) {
+        stp_port_info_t *port = &g_stp_bridge.ports[i];
+        if (!stp_port_can_be_root(port)) {
+            continue;
+        }
+
+        stp_vector_t vector = stp_root_path_vector(port);
+        if (best == PORT_ID_INVALID || compare_vector(&vector, &best_vector) < 0) {
+            best = (port_id_t)i;
+            best_vector = vector;
+        }
+    }
+
+    stp_set_root_port(best);
+}
+
+/**
+ * @brief Recompute after the received vector or path cost of one port changed
+ *
+ * @param port Port whose information changed
+ * @param old_offer Root path vector the port offered before the change
+ */
+static void stp_port_info_changed(stp_port_info_t *port, const stp_vector_t *old_offer) {
+    stp_vector_t offer = stp_root_path_vector(port);
+
+    if (port->port_id == g_stp_bridge.root_port) {
+        // A root port that got better stays the root port
+        if (stp_port_can_be_root(port) && compare_vector(&offer, old_offer) <= 0) {
+            stp_set_root_port(port->port_id);
+        } else {
+            stp_select_root();
+        }
+        return;
+    }
+
+    if (stp_port_can_be_root(port)) {
+        if (g_stp_bridge.root_port >= g_stp_bridge.ports_count) {
+            stp_set_root_port(port->port_id);
+            return;
+        }
+
+        stp_vector_t current = stp_root_path_vector(&g_stp_bridge.ports[g_stp_bridge.root_port]);
+        if (compare_vector(&offer, &current) < 0) {
+            stp_set_root_port(port->port_id);
+            return;
+        }
+    }
+
+    stp_update_port_role(port);
+}
+
+/**
+ * @brief Recompute the root and every port role from scratch
+ *
+ * For configuration changes that all designated vectors depend on, such
+ * as the bridge priority. BPDUs and timers recompute incrementally.
+ */
 static void stp_reconfigure_topology(void) {
-   // Set all ports to blocking except root port
-   for (uint32_t i = 0; i < g_stp_bridge.ports_count; i++) {
-       if (i == g_stp_bridge.root_port) {
-           // Root port should be forwarding
-           stp_port_info_t *port = &g_stp_bridge.ports[i];
-           
-           if (port->state == STP_PORT_STATE_BLOCKING) {
-               port->state = STP_PORT_STATE_LISTENING;
-               port->timer_forward_delay = g_stp_bridge.forward_delay;
-               LOG_INFO(LOG_CATEGORY_L2, "Root port %u transitions from blocking to listening", i);
-           }
-       } else {
-           // Check if this port should be designated port
-           stp_port_info_t *port = &g_stp_bridge.ports[i];
-           bool is_designated = false;
-           
-           // If we're the root bridge, all ports are designated
-           if (compare_bridge_id(g_stp_bridge.root_id, g_stp_bridge.bridge_id) == 0) {
-               is_designated = true;
-           } else {
-               // Check if this port provides the best path to the root for its segment
-               // (This is a simplified check that needs to be expanded in real implementation)
-               if (port->bpdu_received && 
-                   compare_bridge_id(g_stp_bridge.root_id, port->designated_root) < 0) {
-                   is_designated = true;
-               }
-           }
-           
-           if (is_designated) {
-               if (port->state == STP_PORT_STATE_BLOCKING) {
-                   port->state = STP_PORT_STATE_LISTENING;
-                   port->timer_forward_delay = g_stp_bridge.forward_delay;
-                   LOG_INFO(LOG_CATEGORY_L2, "Designated port %u transitions from blocking to listening", i);
-               }
-           } else {
-               if (port->state != STP_PORT_STATE_BLOCKING) {
-                   port->state = STP_PORT_STATE_BLOCKING;
-                   LOG_INFO(LOG_CATEGORY_L2, "Port %u transitions to blocking", i);
-               }
-           }
-       }
-   }
+    stp_select_root();
+
+    for (uint32_t i = 0; i < g_stp_bridge.ports_count; i++) {
+        stp_update_port_role(&g_stp_bridge.ports[i]);
+    }
+}
+
+/**
+ * @brief Get the port a timer callback belongs to, or NULL if stale
+ *
+ * Must be called with the STP lock held. A one-shot timer that was
+ * re-armed while its callback waited for the lock is pending again and
+ * its newer expiry takes over.
+ */
+static stp_port_info_t *stp_timer_port(event_timer_t *timer, void *arg, bool periodic) {
+    port_id_t port_id = (port_id_t)(uintptr_t)arg;
+
+    if (!g_stp_bridge.enabled || port_id >= g_stp_bridge.ports_count) {
+        return NULL;
+    }
+
+    if (!periodic && event_timer_pending(timer)) {
+        return NULL;
+    }
+
+    stp_port_info_t *port = &g_stp_bridge.ports[port_id];
+    return port->state == STP_PORT_STATE_DISABLED ? NULL : port;
+}
+
+static void stp_forward_delay_timer_cb(event_timer_t *timer, void *arg) {
+    stp_acquire_lock();
+
+    stp_port_info_t *port = stp_timer_port(timer, arg, false);
+    if (port && port->state == STP_PORT_STATE_LISTENING) {
+        stp_port_set_state(port, STP_PORT_STATE_LEARNING);
+        stp_timer_start(&port->forward_delay_timer, g_stp_bridge.forward_delay, false);
+        LOG_INFO(LOG_CATEGORY_L2, "Port %u transitions from listening to learning", port->port_id);
+    } else if (port && port->state == STP_PORT_STATE_LEARNING) {
+        stp_port_set_state(port, STP_PORT_STATE_FORWARDING);
+        LOG_INFO(LOG_CATEGORY_L2, "Port %u transitions from learning to forwarding", port->port_id);
+    }
+
+    stp_release_lock();
+}
+
+static void stp_message_age_timer_cb(event_timer_t *timer, void *arg) {
+    stp_acquire_lock();
+
+    stp_port_info_t *port = stp_timer_port(timer, arg, false);
+    if (port && port->bpdu_received) {
+        // The information received on this port has aged out
+        port->bpdu_received = false;
+
+        if (port->port_id == g_stp_bridge.root_port) {
+            LOG_INFO(LOG_CATEGORY_L2, "Message age timer expired on root port %u, electing new root",
+                     port->port_id);
+            stp_select_root();
+        } else {
+            stp_update_port_role(port);
+        }
+    }
+
+    stp_release_lock();
+}
+
+static void stp_tcn_timer_cb(event_timer_t *timer, void *arg) {
+    stp_acquire_lock();
+
+    // Send TCN BPDU on the root port
+    stp_port_info_t *port = stp_timer_port(timer, arg, true);
+    if (port && port->port_id == g_stp_bridge.root_port) {
+        uint8_t frame[STP_BPDU_MAX_SIZE];
+        packet_t tcn_packet = { .data = frame, .capacity = sizeof(frame) };
+        generate_bpdu(port->port_id, STP_BPDU_TCN, &tcn_packet);
+        packet_transmit(&tcn_packet, port->port_id);
+        LOG_INFO(LOG_CATEGORY_L2, "Sent TCN BPDU on root port %u", port->port_id);
+    }
+
+    stp_release_lock();
+}
+
+/**
+ * @brief Get a port's config BPDU ready for transmission
+ *
+ * The template is rebuilt only after the bridge or root vector changed;
+ * otherwise only the per-port flags and message age are patched.
+ * Runs on the event loop thread, which is the only writer of templates.
+ */
+static packet_buffer_t *stp_port_prepare_bpdu(stp_port_info_t *port) {
+    packet_buffer_t *packet = &port->bpdu_packet;
+
+    if (port->bpdu_generation != g_stp_bridge.bpdu_generation) {
+        memset(&packet->metadata, 0, sizeof(packet->metadata));
+        packet->size = 0;
+        generate_bpdu(port->port_id, STP_BPDU_CONFIG, packet);
+        port->bpdu_generation = g_stp_bridge.bpdu_generation;
+        return packet;
+    }
+
+    uint8_t *data = packet->data;
+    uint8_t flags = (port->topology_change ? STP_FLAG_TC : 0) |
+                    (port->topology_change_ack ? STP_FLAG_TCA : 0);
+    uint16_t message_age = port->message_age * 256;
+
+    data[21] = flags;
+    data[44] = (message_age >> 8) & 0xFF;
+    data[45] = message_age & 0xFF;
+    for (uint32_t offset = STP_MST_MSTI_OFFSET; offset < packet->size; offset += STP_MST_MSTI_MSG_LEN) {
+        data[offset] = (data[offset] & ~STP_FLAG_TC) | (flags & STP_FLAG_TC);
+    }
+
+    return packet;
+}
+
+static void stp_hello_timer_cb(event_timer_t *timer, void *arg) {
+    uint32_t count = 0;
+
+    (void)timer;
+    (void)arg;
+
+    stp_acquire_lock();
+
+    // Send BPDUs on all ports if we're the root bridge
+    if (g_stp_bridge.enabled && compare_bridge_id(g_stp_bridge.root_id, g_stp_bridge.bridge_id) == 0) {
+        for (uint32_t i = 0; i < g_stp_bridge.ports_count; i++) {
+            stp_port_info_t *port = &g_stp_bridge.ports[i];
+            if (port->state != STP_PORT_STATE_DISABLED) {
+                stp_port_prepare_bpdu(port);
+                g_stp_bridge.hello_burst[count++] = (port_id_t)i;
+            }
+        }
+    }
+
+    stp_release_lock();
+
+    // The templates are not touched outside this thread, so send the burst unlocked
+    for (uint32_t i = 0; i < count; i++) {
+        port_id_t port_id = g_stp_bridge.hello_burst[i];
+        packet_transmit(&g_stp_bridge.ports[port_id].bpdu_packet, port_id);
+    }
+}
+
+static void stp_topology_change_timer_cb(event_timer_t *timer, void *arg) {
+    (void)arg;
+
+    stp_acquire_lock();
+
+    if (!event_timer_pending(timer) && g_stp_bridge.topology_change) {
+        g_stp_bridge.topology_change_time = 0;
+        g_stp_bridge.topology_change = false;
+        LOG_INFO(LOG_CATEGORY_L2, "Topology change period ended");
+    }
+
+    stp_release_lock();
 }
 
 static status_t process_bpdu(port_id_t port_id, const packet_t *packet) {
@@ -277,8 +964,8 @@ static status_t process_bpdu(port_id_t port_id, const packet_t *packet) {
     uint8_t bpdu_type = packet->data[20];
     stp_port_info_t *port = &g_stp_bridge.ports[port_id];
     
-    if (bpdu_type == STP_BPDU_CONFIG) {
-        // Process config BPDU
+    if (bpdu_type == STP_BPDU_CONFIG || bpdu_type == STP_BPDU_RST) {
+        // Process config BPDU, or the CIST part of an MST BPDU
         if (packet->size < 52) {
             LOG_ERROR(LOG_CATEGORY_L2, "Invalid config BPDU length %u", packet->size);
             return ERROR_INVALID_PACKET;
@@ -312,108 +999,67 @@ static status_t process_bpdu(port_id_t port_id, const packet_t *packet) {
         uint16_t received_hello_time = ((packet->data[48] << 8) | packet->data[49]) / 256;
         uint16_t received_forward_delay = ((packet->data[50] << 8) | packet->data[51]) / 256;
         
-        // Mark that we've received a BPDU on this port
+        stp_vector_t received = {
+            received_root_id, received_root_path_cost, received_bridge_id, received_port_id
+        };
+        stp_vector_t stored = stp_received_vector(port);
+        stp_vector_t old_offer = stp_root_path_vector(port);
+        bool changed = !port->bpdu_received || compare_vector(&received, &stored) != 0;
+
+        // Mark that we've received a BPDU on this port; a bridge behind it means it is not an edge
         port->bpdu_received = true;
-        
+        port->oper_edge = false;
+        port->designated_root = received_root_id;
+        port->root_path_cost = received_root_path_cost;
+        port->designated_bridge = received_bridge_id;
+        port->designated_port = received_port_id;
+        port->message_age = received_message_age;
+
+        // The information stays valid until it reaches max age
+        stp_timer_start(&port->message_age_timer,
+                        received_max_age > received_message_age ? received_max_age - received_message_age : 0,
+                        false);
+
         // Update topology change flags
         if (flags & STP_FLAG_TC) {
-            g_stp_bridge.topology_change = true;
-            g_stp_bridge.topology_change_time = STP_DEFAULT_FORWARD_DELAY * 2;
+            stp_topology_change_start();
+        }
+
+        // A periodic hello repeating known information needs no recomputation
+        if (changed) {
+            stp_port_info_changed(port, &old_offer);
+        }
+
+        // RSTP handshake
+        if (stp_is_rapid() && bpdu_type == STP_BPDU_RST) {
+            if (port_id == g_stp_bridge.root_port && (flags & STP_FLAG_PROPOSAL)) {
+                stp_port_agree(port);
+            } else if (port->role == STP_PORT_ROLE_DESIGNATED && port->proposing &&
+                       (flags & STP_FLAG_AGREEMENT)) {
+                stp_port_set_forwarding(port);
+            }
+        }
+
+        if (port_id == g_stp_bridge.root_port) {
+            // Update timers from root
+            if (g_stp_bridge.max_age != received_max_age ||
+                g_stp_bridge.hello_time != received_hello_time ||
+                g_stp_bridge.forward_delay != received_forward_delay) {
+                stp_invalidate_bpdus();
+            }
+            g_stp_bridge.max_age = received_max_age;
+            g_stp_bridge.hello_time = received_hello_time;
+            g_stp_bridge.forward_delay = received_forward_delay;
+
+            // Reset topology change notification
+            (void)event_timer_stop(&port->tcn_timer);
         }
-        
-        // Check if this is a superior BPDU (better root or same root with better path)
-        int root_comparison = compare_bridge_id(received_root_id, g_stp_bridge.root_id);
-        bool is_superior = false;
-        if (root_comparison < 0) {
-           // Received root is better than our current root
-           is_superior = true;
-       } else if (root_comparison == 0) {
-           // Same root, compare path cost
-           if (received_root_path_cost < g_stp_bridge.root_path_cost) {
-               is_superior = true;
-           } else if (received_root_path_cost == g_stp_bridge.root_path_cost) {
-               // Same path cost, compare sending bridge ID
-               int bridge_comparison = compare_bridge_id(received_bridge_id, g_stp_bridge.bridge_id);
-               if (bridge_comparison < 0) {
-                   is_superior = true;
-               } else if (bridge_comparison == 0) {
-                   // Same bridge (should not happen unless we're getting our own BPDU back)
-                   // Compare port IDs
-                   if (received_port_id < port_id) {
-                       is_superior = true;
-                   }
-               }
-           }
-       }
-       
-       if (is_superior) {
-           // Update root bridge info
-           g_stp_bridge.root_id = received_root_id;
-           g_stp_bridge.root_path_cost = received_root_path_cost + port->path_cost;
-           g_stp_bridge.root_port = port_id;
-           
-           // Update timers from root
-           g_stp_bridge.max_age = received_max_age;
-           g_stp_bridge.hello_time = received_hello_time;
-           g_stp_bridge.forward_delay = received_forward_delay;
-           
-           // Update port info
-           port->designated_root = received_root_id;
-           port->root_path_cost = received_root_path_cost;
-           port->designated_bridge = received_bridge_id;
-           port->designated_port = received_port_id;
-           port->message_age = received_message_age;
-           
-           // Reset topology change notification
-           port->timer_tcn = 0;
-           
-           // Start reconfiguration process
-           stp_reconfigure_topology();
-           
-           LOG_INFO(LOG_CATEGORY_L2, "Superior BPDU received on port %u, new root bridge ID: %04x:%02x:%02x:%02x:%02x:%02x:%02x:%02x",
-                    port_id,
-                    g_stp_bridge.root_id.priority,
-                    g_stp_bridge.root_id.mac_address.addr[0],
-                    g_stp_bridge.root_id.mac_address.addr[1],
-                    g_stp_bridge.root_id.mac_address.addr[2],
-                    g_stp_bridge.root_id.mac_address.addr[3],
-                    g_stp_bridge.root_id.mac_address.addr[4],
-                    g_stp_bridge.root_id.mac_address.addr[5]);
-       } else {
-           // Check if this port should be designated port
-           if (compare_bridge_id(received_root_id, port->designated_root) > 0 ||
-               (compare_bridge_id(received_root_id, port->designated_root) == 0 &&
-                received_root_path_cost > port->root_path_cost) ||
-               (compare_bridge_id(received_root_id, port->designated_root) == 0 &&
-                received_root_path_cost == port->root_path_cost &&
-                compare_bridge_id(received_bridge_id, port->designated_bridge) > 0) ||
-               (compare_bridge_id(received_root_id, port->designated_root) == 0 &&
-                received_root_path_cost == port->root_path_cost &&
-                compare_bridge_id(received_bridge_id, port->designated_bridge) == 0 &&
-                received_port_id > port->designated_port)) {
-               
-               // This port should be designated port
-               if (port->state == STP_PORT_STATE_BLOCKING) {
-                   // Move to listening state
-                   port->state = STP_PORT_STATE_LISTENING;
-                   port->timer_forward_delay = g_stp_bridge.forward_delay;
-                   LOG_INFO(LOG_CATEGORY_L2, "Port %u transitions from blocking to listening", port_id);
-               }
-           } else {
-               // This port should be blocked
-               if (port->state != STP_PORT_STATE_BLOCKING) {
-                   port->state = STP_PORT_STATE_BLOCKING;
-                   LOG_INFO(LOG_CATEGORY_L2, "Port %u transitions to blocking", port_id);
-               }
-           }
-       }
    } else if (bpdu_type == STP_BPDU_TCN) {
        // Process topology change notification BPDU
        LOG_INFO(LOG_CATEGORY_L2, "TCN BPDU received on port %u", port_id);
        
        // Set topology change flag
-       g_stp_bridge.topology_change = true;
-       g_stp_bridge.topology_change_time = STP_DEFAULT_FORWARD_DELAY * 2;
+       stp_topology_change_start();
        
        // Set topology change acknowledgment in next BPDU
        port->topology_change_ack = true;
@@ -425,117 +1071,68 @@ static status_t process_bpdu(port_id_t port_id, const packet_t *packet) {
    return STATUS_SUCCESS;
 }
 
-static void stp_update_port_states(uint32_t current_time) {
-   static uint32_t last_time = 0;
-   
-   // If time hasn't advanced, nothing to do
-   if (current_time == last_time) {
-       return;
-   }
-   
-   uint32_t elapsed = current_time - last_time;
-   last_time = current_time;
-   
-   // Update bridge timers
-   if (g_stp_bridge.timer_hello > 0) {
-       if (g_stp_bridge.timer_hello <= elapsed) {
-           g_stp_bridge.timer_hello = g_stp_bridge.hello_time;
-           
-           // Send BPDUs on all ports if we're the root bridge
-           if (compare_bridge_id(g_stp_bridge.root_id, g_stp_bridge.bridge_id) == 0) {
-               for (uint32_t i = 0; i < g_stp_bridge.ports_count; i++) {
-                   stp_port_info_t *port = &g_stp_bridge.ports[i];
-                   if (port->state != STP_PORT_STATE_DISABLED) {
-                       packet_t bpdu_packet = {0};
-                       generate_bpdu(i, STP_BPDU_CONFIG, &bpdu_packet);
-                       //port_send_packet(i, &bpdu_packet);
-                       packet_transmit(&bpdu_packet, i);
-                   }
-               }
-           }
-       } else {
-           g_stp_bridge.timer_hello -= elapsed;
+/**
+ * @brief Apply a link change to a port, with the STP lock held
+ *
+ * @return true if the root port went down and the root must be reselected
+ */
+static bool stp_port_apply_link(stp_port_info_t *port, bool link_up) {
+   if (link_up) {
+       // If port was disabled due to link down, restart it
+       if (port->state == STP_PORT_STATE_DISABLED) {
+           stp_port_set_state(port, STP_PORT_STATE_BLOCKING);
+           port->bpdu_received = false;
+           port->oper_edge = port->edge;
+           LOG_INFO(LOG_CATEGORY_L2, "Port %u link up, starting in blocking state", port->port_id);
+           stp_update_port_role(port);
        }
+       return false;
    }
-   
-   if (g_stp_bridge.topology_change_time > 0) {
-       if (g_stp_bridge.topology_change_time <= elapsed) {
-           g_stp_bridge.topology_change_time = 0;
-           g_stp_bridge.topology_change = false;
-           LOG_INFO(LOG_CATEGORY_L2, "Topology change period ended");
-       } else {
-           g_stp_bridge.topology_change_time -= elapsed;
-       }
+
+   // Link went down, mark port as disabled
+   if (port->state == STP_PORT_STATE_DISABLED) {
+       return false;
    }
-   
-   // Update port timers and states
-   for (uint32_t i = 0; i < g_stp_bridge.ports_count; i++) {
-       stp_port_info_t *port = &g_stp_bridge.ports[i];
-       
-       // Skip disabled ports
-       if (port->state == STP_PORT_STATE_DISABLED) {
-           continue;
-       }
-       
-       // Update message age timer
-       if (port->timer_message_age > 0) {
-           if (port->timer_message_age <= elapsed) {
-               port->timer_message_age = 0;
-               
-               // Message age expiry means we lost contact with the root
-               if (i == g_stp_bridge.root_port) {
-                   LOG_INFO(LOG_CATEGORY_L2, "Message age timer expired on root port %u, electing new root", i);
-                   
-                   // Become root ourselves
-                   g_stp_bridge.root_id = g_stp_bridge.bridge_id;
-                   g_stp_bridge.root_path_cost = 0;
-                   g_stp_bridge.root_port = PORT_ID_INVALID;
-                   
-                   // Reconfigure topology
-                   stp_reconfigure_topology();
-               }
-           } else {
-               port->timer_message_age -= elapsed;
-           }
+
+   LOG_INFO(LOG_CATEGORY_L2, "Port %u link down, marking as disabled", port->port_id);
+   stp_port_stop_timers(port);
+   stp_port_set_state(port, STP_PORT_STATE_DISABLED);
+
+   // If this was the root port, need to elect a new one
+   return port->port_id == g_stp_bridge.root_port;
+}
+
+/**
+ * @brief Apply a link event batch under one lock, reselecting the root once
+ */
+static void stp_link_batch(const link_event_batch_t *batch, void *arg) {
+   bool reselect = false;
+
+   (void)arg;
+
+   BITMAP_FOR_EACH(port_id, batch->changed, LINK_EVENT_PORT_WORDS) {
+       if (port_id < g_stp_bridge.ports_count) {
+           (void)vlan_set_port_link((port_id_t)port_id, link_event_batch_up(batch, (port_id_t)port_id));
        }
-       
-       // Update TCN timer
-       if (port->timer_tcn > 0) {
-           if (port->timer_tcn <= elapsed) {
-               port->timer_tcn = STP_TCN_TIMER;
-               
-               // Send TCN BPDU on the root port
-               if (i == g_stp_bridge.root_port) {
-                   packet_t tcn_packet = {0};
-                   generate_bpdu(i, STP_BPDU_TCN, &tcn_packet);
-                   // port_send_packet(i, &tcn_packet);
-                   packet_transmit(&tcn_packet, i);
-                   LOG_INFO(LOG_CATEGORY_L2, "Sent TCN BPDU on root port %u", i);
-               }
-           } else {
-               port->timer_tcn -= elapsed;
+   }
+
+   stp_acquire_lock();
+
+   if (g_stp_bridge.enabled && g_stp_bridge.ports) {
+       BITMAP_FOR_EACH(port_id, batch->changed, LINK_EVENT_PORT_WORDS) {
+           if (port_id < g_stp_bridge.ports_count &&
+               stp_port_apply_link(&g_stp_bridge.ports[port_id],
+                                   link_event_batch_up(batch, (port_id_t)port_id))) {
+               reselect = true;
            }
        }
-       
-       // Update forward delay timer
-       if (port->timer_forward_delay > 0) {
-           if (port->timer_forward_delay <= elapsed) {
-               port->timer_forward_delay = 0;
-               
-               // State transitions
-               if (port->state == STP_PORT_STATE_LISTENING) {
-                   port->state = STP_PORT_STATE_LEARNING;
-                   port->timer_forward_delay = g_stp_bridge.forward_delay;
-                   LOG_INFO(LOG_CATEGORY_L2, "Port %u transitions from listening to learning", i);
-               } else if (port->state == STP_PORT_STATE_LEARNING) {
-                   port->state = STP_PORT_STATE_FORWARDING;
-                   LOG_INFO(LOG_CATEGORY_L2, "Port %u transitions from learning to forwarding", i);
-               }
-           } else {
-               port->timer_forward_delay -= elapsed;
-           }
+
+       if (reselect) {
+           stp_select_root();
        }
    }
+
+   stp_release_lock();
 }
 
 status_t stp_init(const stp_config_t *config ) {
@@ -553,13 +1150,22 @@ status_t stp_init(const stp_config_t *config ) {
    
    // Allocate memory for port information
    g_stp_bridge.ports = malloc(sizeof(stp_port_info_t) * num_ports);
-   if (!g_stp_bridge.ports) {
+   g_stp_bridge.bpdu_templates = malloc((size_t)STP_BPDU_MAX_SIZE * num_ports);
+   g_stp_bridge.hello_burst = malloc(sizeof(port_id_t) * num_ports);
+   if (!g_stp_bridge.ports || !g_stp_bridge.bpdu_templates || !g_stp_bridge.hello_burst) {
        LOG_ERROR(LOG_CATEGORY_L2, "Failed to allocate memory for STP ports");
+       free(g_stp_bridge.ports);
+       free(g_stp_bridge.bpdu_templates);
+       free(g_stp_bridge.hello_burst);
+       g_stp_bridge.ports = NULL;
+       g_stp_bridge.bpdu_templates = NULL;
+       g_stp_bridge.hello_burst = NULL;
        return STATUS_MEMORY_ALLOCATION_FAILED;
    }
    
    // Initialize bridge
    g_stp_bridge.enabled = config->enabled;
+   g_stp_bridge.version = config->version;
    g_stp_bridge.bridge_id = config->bridge_id;
    
    // Initially, we consider ourselves the root
@@ -571,17 +1177,30 @@ status_t stp_init(const stp_config_t *config ) {
    g_stp_bridge.max_age = config->max_age;
    g_stp_bridge.hello_time = config->hello_time;
    g_stp_bridge.forward_delay = config->forward_delay;
-   g_stp_bridge.timer_hello = config->hello_time;
    g_stp_bridge.topology_change = false;
    g_stp_bridge.topology_change_time = 0;
    g_stp_bridge.ports_count = num_ports;
-
+   memset(g_stp_bridge.vlan_instance, STP_CIST_ID, sizeof(g_stp_bridge.vlan_instance));
+   memset(g_stp_bridge.instance_vlans, 0, sizeof(g_stp_bridge.instance_vlans));
+   g_stp_bridge.bpdu_generation = 1;
+   event_timer_init(&g_stp_bridge.hello_timer, stp_hello_timer_cb, NULL);
+   event_timer_init(&g_stp_bridge.topology_change_timer, stp_topology_change_timer_cb, NULL);
 
    // Initialize ports
    for (uint32_t i = 0; i < num_ports; i++) {
        stp_port_info_t *port = &g_stp_bridge.ports[i];
        port->port_id = i;
-       port->state = STP_PORT_STATE_BLOCKING;
+       // MSTIs discard until their state is set
+       memset(port->instance_state, 0, sizeof(port->instance_state));
+       memset(&port->bpdu_packet, 0, sizeof(port->bpdu_packet));
+       port->bpdu_packet.data = &g_stp_bridge.bpdu_templates[(size_t)i * STP_BPDU_MAX_SIZE];
+       port->bpdu_packet.capacity = STP_BPDU_MAX_SIZE;
+       port->bpdu_generation = 0;
+       port->role = STP_PORT_ROLE_DISABLED;
+       port->edge = false;
+       port->oper_edge = false;
+       port->proposing = false;
+       stp_port_set_state(port, STP_PORT_STATE_BLOCKING);
        port->port_priority = STP_DEFAULT_PORT_PRIORITY;
        port->path_cost = STP_DEFAULT_PATH_COST;
        port->designated_root = g_stp_bridge.root_id;
@@ -595,32 +1214,22 @@ status_t stp_init(const stp_config_t *config ) {
        port->topology_change = false;
        port->topology_change_ack = false;
        
-       // Выделение памяти для информации о VLAN
-       port->vlans = calloc(MAX_VLANS, sizeof(struct stp_vlan_info));
-       if (!port->vlans) {
-           LOG_ERROR(LOG_CATEGORY_L2, "Failed to allocate memory for STP VLAN states");
-           // Освобождаем ранее выделенную память
-           for (uint32_t j = 0; j < i; j++) {
-               if (g_stp_bridge.ports[j].vlans) {
-                   free(g_stp_bridge.ports[j].vlans);
-               }
-           }
-           free(g_stp_bridge.ports);
-           g_stp_bridge.ports = NULL;
-           return STATUS_MEMORY_ALLOCATION_FAILED;
-       }
-       port->vlans_allocated = MAX_VLANS;
+       void *timer_arg = (void *)(uintptr_t)i;
+       event_timer_init(&port->tcn_timer, stp_tcn_timer_cb, timer_arg);
+       event_timer_init(&port->forward_delay_timer, stp_forward_delay_timer_cb, timer_arg);
+       event_timer_init(&port->message_age_timer, stp_message_age_timer_cb, timer_arg);
+       port->bpdu_received = false;
+   }
 
-       // Инициализация состояний VLAN по умолчанию
-       for (uint16_t j = 0; j < MAX_VLANS; j++) {
-           port->vlans[j].state = port->state; // Используем то же состояние, что и у порта
-       }
+   // Nothing ticks STP any more, so roles must be assigned up front
+   if (g_stp_bridge.enabled) {
+       stp_timer_start(&g_stp_bridge.hello_timer, g_stp_bridge.hello_time, true);
+       stp_reconfigure_topology();
+   }
 
-       port->timer_hello = 0;
-       port->timer_tcn = 0;
-       port->timer_forward_delay = 0;
-       port->timer_message_age = 0;
-       port->bpdu_received = false;
+   // Link changes arrive coalesced, a batch per STP lock round
+   if (link_event_subscribe(stp_link_batch, NULL) != STATUS_SUCCESS) {
+       LOG_WARNING(LOG_CATEGORY_L2, "STP not subscribed to link events");
    }
    
    LOG_INFO(LOG_CATEGORY_L2, "STP initialized with bridge ID: %04x:%02x:%02x:%02x:%02x:%02x:%02x:%02x",
@@ -636,21 +1245,27 @@ status_t stp_init(const stp_config_t *config ) {
 }
 
 status_t stp_deinit(void) {
+   (void)link_event_unsubscribe(stp_link_batch, NULL);
+
    stp_acquire_lock();
 
+   (void)event_timer_stop(&g_stp_bridge.hello_timer);
+   (void)event_timer_stop(&g_stp_bridge.topology_change_timer);
+
    if (g_stp_bridge.ports) {
-       // Освобождение памяти для VLAN в каждом порту
+       // Останов таймеров каждого порта
        for (uint32_t i = 0; i < g_stp_bridge.ports_count; i++) {
-           if (g_stp_bridge.ports[i].vlans) {
-               free(g_stp_bridge.ports[i].vlans);
-               g_stp_bridge.ports[i].vlans = NULL;
-           }
+           stp_port_stop_timers(&g_stp_bridge.ports[i]);
        }
 
        free(g_stp_bridge.ports);
        g_stp_bridge.ports = NULL;
    }
 
+   free(g_stp_bridge.bpdu_templates);
+   free(g_stp_bridge.hello_burst);
+   g_stp_bridge.bpdu_templates = NULL;
+   g_stp_bridge.hello_burst = NULL;
    g_stp_bridge.ports_count = 0;
    g_stp_bridge.enabled = false;
 
@@ -671,26 +1286,37 @@ status_t stp_set_enabled(bool enable) {
        for (uint32_t i = 0; i < g_stp_bridge.ports_count; i++) {
            stp_port_info_t *port = &g_stp_bridge.ports[i];
            if (port->state != STP_PORT_STATE_DISABLED) {
-               port->state = STP_PORT_STATE_BLOCKING;
+               stp_port_set_state(port, STP_PORT_STATE_BLOCKING);
            }
        }
 
-       // If we're enabling STP, start the hello timer
-       g_stp_bridge.timer_hello = 0;  // Trigger immediate BPDU transmission
+       // If we're enabling STP, start the hello timer with an immediate BPDU transmission
+       (void)event_timer_start(&g_stp_bridge.hello_timer, 0,
+                               (uint64_t)g_stp_bridge.hello_time * STP_USEC_PER_SEC);
+       stp_reconfigure_topology();
 
        LOG_INFO(LOG_CATEGORY_L2, "STP enabled");
    } else if (was_enabled && !enable) {
        // If we're disabling STP, set all ports to forwarding
+       (void)event_timer_stop(&g_stp_bridge.hello_timer);
        for (uint32_t i = 0; i < g_stp_bridge.ports_count; i++) {
            stp_port_info_t *port = &g_stp_bridge.ports[i];
+           stp_port_stop_timers(port);
            if (port->state != STP_PORT_STATE_DISABLED) {
-               port->state = STP_PORT_STATE_FORWARDING;
+               stp_port_set_state(port, STP_PORT_STATE_FORWARDING);
            }
        }
 
        LOG_INFO(LOG_CATEGORY_L2, "STP disabled");
    }
 
+   // Ports left untouched above (disabled ones) still change forwarding eligibility
+   for (uint32_t i = 0; i < g_stp_bridge.ports_count; i++) {
+       stp_port_info_t *port = &g_stp_bridge.ports[i];
+       (void)vlan_set_port_forwarding(port->port_id,
+                                      !enable || port->state == STP_PORT_STATE_FORWARDING);
+   }
+
    stp_release_lock();
    return STATUS_SUCCESS;
 }
@@ -699,6 +1325,7 @@ status_t stp_set_bridge_priority(uint16_t priority) {
    stp_acquire_lock();
 
    g_stp_bridge.bridge_id.priority = priority;
+   stp_invalidate_bpdus();
 
    // If new priority makes this bridge the root, update root info
    bridge_id_t old_root_id __attribute__((unused)) = g_stp_bridge.root_id;
@@ -726,10 +1353,11 @@ status_t stp_set_port_priority(port_id_t port_id, uint8_t priority) {
    stp_acquire_lock();
 
    g_stp_bridge.ports[port_id].port_priority = priority;
+   stp_port_invalidate_bpdu(&g_stp_bridge.ports[port_id]);
 
-   // If this is the root port, check if another port should become root
-   if (port_id == g_stp_bridge.root_port) {
-       stp_reconfigure_topology();
+   // Only this port's designated vector depends on its priority
+   if (g_stp_bridge.enabled) {
+       stp_update_port_role(&g_stp_bridge.ports[port_id]);
    }
 
    LOG_INFO(LOG_CATEGORY_L2, "Port %u priority set to %u", port_id, priority);
@@ -746,20 +1374,16 @@ status_t stp_set_port_path_cost(port_id_t port_id, uint32_t path_cost) {
 
    stp_acquire_lock();
 
-   g_stp_bridge.ports[port_id].path_cost = path_cost;
+   stp_port_info_t *port = &g_stp_bridge.ports[port_id];
+   stp_vector_t old_offer = stp_root_path_vector(port);
 
-   // If this is the root port, recalculate root path cost
-   if (port_id == g_stp_bridge.root_port) {
-       // Recalculate total path cost to root
-       g_stp_bridge.root_path_cost = g_stp_bridge.ports[port_id].root_path_cost + path_cost;
+   port->path_cost = path_cost;
 
-       // Send updated BPDUs
-       g_stp_bridge.timer_hello = 0;  // Trigger immediate BPDU transmission
+   // The root path cost and root port election depend on the new cost
+   if (g_stp_bridge.enabled) {
+       stp_port_info_changed(port, &old_offer);
    }
 
-   // Check if topology needs to be reconfigured
-   stp_reconfigure_topology();
-
    LOG_INFO(LOG_CATEGORY_L2, "Port %u path cost set to %u", port_id, path_cost);
 
    stp_release_lock();
@@ -778,20 +1402,23 @@ status_t stp_set_port_enabled(port_id_t port_id, bool enable) {
 
    if (enable && port->state == STP_PORT_STATE_DISABLED) {
        // If this port was disabled, enable it and set to blocking
-       port->state = STP_PORT_STATE_BLOCKING;
-       port->timer_message_age = 0;
-       port->timer_forward_delay = 0;
+       stp_port_set_state(port, STP_PORT_STATE_BLOCKING);
        port->bpdu_received = false;
+       port->oper_edge = port->edge;
+       if (g_stp_bridge.enabled) {
+           stp_update_port_role(port);
+       }
 
        LOG_INFO(LOG_CATEGORY_L2, "STP enabled on port %u", port_id);
    } else if (!enable && port->state != STP_PORT_STATE_DISABLED) {
        // If this port was enabled, disable it
-       port->state = STP_PORT_STATE_DISABLED;
+       stp_port_stop_timers(port);
+       stp_port_set_state(port, STP_PORT_STATE_DISABLED);
 
        // If this was the root port, we need a new one
        if (port_id == g_stp_bridge.root_port) {
            // Find new root port or become root
-           stp_reconfigure_topology();
+           stp_select_root();
        }
 
        LOG_INFO(LOG_CATEGORY_L2, "STP disabled on port %u", port_id);
@@ -801,50 +1428,152 @@ status_t stp_set_port_enabled(port_id_t port_id, bool enable) {
    return STATUS_SUCCESS;
 }
 
+status_t stp_set_port_edge(port_id_t port_id, bool edge) {
+   if (!port_is_valid(port_id) || port_id >= g_stp_bridge.ports_count) {
+       LOG_ERROR(LOG_CATEGORY_L2, "Invalid port ID %u", port_id);
+       return ERROR_INVALID_STATE;
+   }
+
+   stp_acquire_lock();
+
+   stp_port_info_t *port = &g_stp_bridge.ports[port_id];
+   port->edge = edge;
+   port->oper_edge = edge && !port->bpdu_received;
+   if (g_stp_bridge.enabled) {
+       stp_update_port_role(port);
+   }
+
+   LOG_INFO(LOG_CATEGORY_L2, "Port %u edge %s", port_id, edge ? "enabled" : "disabled");
+
+   stp_release_lock();
+   return STATUS_SUCCESS;
+}
+
+status_t stp_get_port_role(port_id_t port_id, stp_port_role_t *role) {
+   if (!port_is_valid(port_id) || port_id >= g_stp_bridge.ports_count) {
+       LOG_ERROR(LOG_CATEGORY_L2, "Invalid port ID %u", port_id);
+       return ERROR_INVALID_STATE;
+   }
+
+   if (!role) {
+       LOG_ERROR(LOG_CATEGORY_L2, "Invalid role pointer");
+       return ERROR_INVALID_PARAMETER;
+   }
+
+   stp_acquire_lock();
+   *role = g_stp_bridge.ports[port_id].role;
+   stp_release_lock();
+
+   return STATUS_SUCCESS;
+}
+
 status_t stp_get_port_state(port_id_t port_id, vlan_id_t vlan_id, stp_port_state_t *state) {
-    if (!port_is_valid(port_id) || port_id >= g_stp_bridge.ports_count) {
-        LOG_ERROR(LOG_CATEGORY_L2, "Invalid port ID %u", port_id);
+    if (vlan_id >= MAX_VLANS) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Invalid VLAN ID %u", vlan_id);
         return STATUS_INVALID_PARAMETER;
     }
 
+    return stp_get_port_instance_state(port_id, g_stp_bridge.vlan_instance[vlan_id], state);
+}
+
+status_t stp_set_port_vlan_state(port_id_t port_id, vlan_id_t vlan_id, stp_port_state_t state) {
     if (vlan_id >= MAX_VLANS) {
         LOG_ERROR(LOG_CATEGORY_L2, "Invalid VLAN ID %u", vlan_id);
         return STATUS_INVALID_PARAMETER;
     }
 
-    if (!state) {
-        LOG_ERROR(LOG_CATEGORY_L2, "Invalid state pointer");
+    return stp_set_port_instance_state(port_id, g_stp_bridge.vlan_instance[vlan_id], state);
+}
+
+status_t stp_set_vlan_instance(vlan_id_t vlan_id, uint16_t msti_id) {
+    if (vlan_id >= MAX_VLANS) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Invalid VLAN ID %u", vlan_id);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (msti_id > STP_MAX_MSTI) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Invalid MSTI %u", msti_id);
         return STATUS_INVALID_PARAMETER;
     }
 
     stp_acquire_lock();
-    *state = g_stp_bridge.ports[port_id].vlans[vlan_id].state;
+
+    uint8_t old_id = g_stp_bridge.vlan_instance[vlan_id];
+    if (old_id != msti_id) {
+        g_stp_bridge.instance_vlans[old_id]--;
+        g_stp_bridge.instance_vlans[msti_id]++;
+
+        // An MSTI gained its first or lost its last VLAN
+        if ((old_id != STP_CIST_ID && g_stp_bridge.instance_vlans[old_id] == 0) ||
+            (msti_id != STP_CIST_ID && g_stp_bridge.instance_vlans[msti_id] == 1)) {
+            stp_invalidate_bpdus();
+        }
+        __atomic_store_n(&g_stp_bridge.vlan_instance[vlan_id], (uint8_t)msti_id, __ATOMIC_RELEASE);
+        LOG_INFO(LOG_CATEGORY_L2, "VLAN %u mapped to MSTI %u", vlan_id, msti_id);
+    }
+
     stp_release_lock();
+    return STATUS_SUCCESS;
+}
+
+status_t stp_get_vlan_instance(vlan_id_t vlan_id, uint16_t *msti_id) {
+    if (vlan_id >= MAX_VLANS || !msti_id) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Invalid parameters");
+        return STATUS_INVALID_PARAMETER;
+    }
 
+    *msti_id = __atomic_load_n(&g_stp_bridge.vlan_instance[vlan_id], __ATOMIC_ACQUIRE);
     return STATUS_SUCCESS;
 }
 
+status_t stp_get_port_instance_state(port_id_t port_id, uint16_t msti_id, stp_port_state_t *state) {
+    if (!port_is_valid(port_id) || port_id >= g_stp_bridge.ports_count) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Invalid port ID %u", port_id);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (msti_id > STP_MAX_MSTI) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Invalid MSTI %u", msti_id);
+        return STATUS_INVALID_PARAMETER;
+    }
 
+    if (!state) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Invalid state pointer");
+        return STATUS_INVALID_PARAMETER;
+    }
 
-status_t stp_set_port_vlan_state(port_id_t port_id, vlan_id_t vlan_id, stp_port_state_t state) {
+    stp_acquire_lock();
+
+    stp_port_info_t *port = &g_stp_bridge.ports[port_id];
+    if (msti_id == STP_CIST_ID) {
+        *state = port->state;
+    } else {
+        *state = stp_instance_unpack_state(stp_port_instance_bits(port, msti_id));
+    }
+
+    stp_release_lock();
+    return STATUS_SUCCESS;
+}
+
+status_t stp_set_port_instance_state(port_id_t port_id, uint16_t msti_id, stp_port_state_t state) {
     if (!port_is_valid(port_id) || port_id >= g_stp_bridge.ports_count) {
         LOG_ERROR(LOG_CATEGORY_L2, "Invalid port ID %u", port_id);
         return STATUS_INVALID_PARAMETER;
     }
 
-    if (vlan_id >= MAX_VLANS) {
-        LOG_ERROR(LOG_CATEGORY_L2, "Invalid VLAN ID %u", vlan_id);
+    if (msti_id == STP_CIST_ID || msti_id > STP_MAX_MSTI) {
+        // CIST states are computed by the protocol
+        LOG_ERROR(LOG_CATEGORY_L2, "Invalid MSTI %u", msti_id);
         return STATUS_INVALID_PARAMETER;
     }
 
     stp_acquire_lock();
-    g_stp_bridge.ports[port_id].vlans[vlan_id].state = state;
+    stp_port_set_instance_bits(&g_stp_bridge.ports[port_id], msti_id, state);
     stp_release_lock();
 
     return STATUS_SUCCESS;
 }
 
-
 status_t stp_receive_bpdu(port_id_t port_id, const packet_t *packet) {
    if (!port_is_valid(port_id) || port_id >= g_stp_bridge.ports_count) {
        LOG_ERROR(LOG_CATEGORY_L2, "Invalid port ID %u", port_id);
@@ -870,21 +1599,6 @@ status_t stp_receive_bpdu(port_id_t port_id, const packet_t *packet) {
    return result;
 }
 
-status_t stp_update(uint32_t current_time) {
-   // Check if STP is enabled
-   if (!g_stp_bridge.enabled) {
-       return ERROR_NOT_INITIALIZED;
-   }
-
-   stp_acquire_lock();
-
-   // Update port states based on timers
-   stp_update_port_states(current_time);
-
-   stp_release_lock();
-   return STATUS_SUCCESS;
-}
-
 status_t stp_is_port_forwarding(port_id_t port_id, bool *forwarding) {
    if (!port_is_valid(port_id) || port_id >= g_stp_bridge.ports_count) {
        LOG_ERROR(LOG_CATEGORY_L2, "Invalid port ID %u", port_id);
@@ -904,25 +1618,19 @@ status_t stp_is_port_forwarding(port_id_t port_id, bool *forwarding) {
    return STATUS_SUCCESS;
 }
 
-bool stp_can_forward(port_id_t port_id) {
+bool stp_can_forward(port_id_t port_id, vlan_id_t vlan_id) {
    if (!g_stp_bridge.enabled) {
        // If STP is disabled, all ports can forward
        return true;
    }
 
-   if (!port_is_valid(port_id) || port_id >= g_stp_bridge.ports_count) {
-       LOG_ERROR(LOG_CATEGORY_L2, "Invalid port ID %u", port_id);
+   if (port_id >= g_stp_bridge.ports_count || vlan_id >= MAX_VLANS) {
        return false;
    }
 
-   stp_acquire_lock();
-
-   stp_port_state_t state = g_stp_bridge.ports[port_id].state;
-
-   stp_release_lock();
-
-   // Only forwarding ports can forward data
-   return (state == STP_PORT_STATE_FORWARDING);
+   // VLAN to instance, then the port's state word for that instance
+   uint32_t msti = __atomic_load_n(&g_stp_bridge.vlan_instance[vlan_id], __ATOMIC_ACQUIRE);
+   return stp_port_instance_bits(&g_stp_bridge.ports[port_id], msti) == STP_INSTANCE_FORWARDING;
 }
 
 status_t stp_port_link_change(port_id_t port_id, bool link_up) {
@@ -931,34 +1639,17 @@ status_t stp_port_link_change(port_id_t port_id, bool link_up) {
        return ERROR_INVALID_STATE;
    }
 
+   (void)vlan_set_port_link(port_id, link_up);
+
    // Check if STP is enabled
    if (!g_stp_bridge.enabled) {
        return STATUS_SUCCESS;
    }
 
    stp_acquire_lock();
-
-   stp_port_info_t *port = &g_stp_bridge.ports[port_id];
-
-   if (link_up) {
-       // If port was disabled due to link down, restart it
-       if (port->state == STP_PORT_STATE_DISABLED) {
-           port->state = STP_PORT_STATE_BLOCKING;
-           LOG_INFO(LOG_CATEGORY_L2, "Port %u link up, starting in blocking state", port_id);
-       }
-   } else {
-       // Link went down, mark port as disabled
-       if (port->state != STP_PORT_STATE_DISABLED) {
-           LOG_INFO(LOG_CATEGORY_L2, "Port %u link down, marking as disabled", port_id);
-           port->state = STP_PORT_STATE_DISABLED;
-
-           // If this was the root port, need to elect a new one
-           if (port_id == g_stp_bridge.root_port) {
-               stp_reconfigure_topology();
-           }
-       }
+   if (stp_port_apply_link(&g_stp_bridge.ports[port_id], link_up)) {
+       stp_select_root();
    }
-
    stp_release_lock();
    return STATUS_SUCCESS;
 }
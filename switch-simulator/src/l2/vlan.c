@@ -12,10 +12,19 @@
 #include "common/types.h"
 #include "common/error_codes.h"
 #include "common/logging.h"
+#include "common/mem_account.h"
+#include "common/switch_context.h"
 #include "common/threading.h"
+#include "common/rcu.h"
+#include "common/sim_numa.h"
+#include "common/stats_shard.h"
+#include "common/bitmap.h"
 #include "hal/port.h"
 #include "hal/packet.h"
+#include "hal/packet_drop.h"
 #include "l2/vlan.h"
+#include "l2/lag.h"
+#include "l2/storm_control.h"
 
 /**
  * @brief Default VLAN parameters
@@ -24,6 +33,17 @@
 #define VLAN_MAX_COUNT 4096
 #define VLAN_INVALID_ID 0xFFFF
 
+/**
+ * @brief Per-VLAN traffic counters, in a stats_shard set
+ */
+enum {
+    VLAN_CTR_RX_PACKETS,
+    VLAN_CTR_RX_BYTES,
+    VLAN_CTR_TX_PACKETS,
+    VLAN_CTR_TX_BYTES,
+    VLAN_CTR_WORDS
+};
+
 #define VLAN_LOCK() spinlock_acquire(&g_vlan_state.lock)
 #define VLAN_UNLOCK() spinlock_release(&g_vlan_state.lock)
 
@@ -51,8 +71,10 @@ typedef struct {
     vlan_id_t vlan_id;            // VLAN ID
     bool active;                  // Whether this VLAN is active
     char name[VLAN_NAME_MAX_LEN]; // VLAN name
-    uint8_t *port_membership;     // Bitmap of member ports
-    uint8_t *untagged_ports;      // Bitmap of untagged ports
+    uint64_t port_membership[VLAN_PORT_WORDS]; // Bitmap of member ports
+    uint64_t untagged_ports[VLAN_PORT_WORDS];  // Bitmap of untagged ports
+    uint64_t flood_ports[VLAN_PORT_WORDS];     // Members that are forwarding and link-up
+    uint64_t egress_xlate_ports[VLAN_PORT_WORDS]; // Ports that send this VLAN under another VID
 } vlan_internal_entry_t;
 
 /**
@@ -62,9 +84,43 @@ typedef struct {
     port_vlan_mode_t mode;        // Port VLAN mode
     vlan_id_t access_vlan;        // Access VLAN ID for this port
     vlan_id_t native_vlan;        // Native VLAN ID for trunk/hybrid mode
-    uint8_t *allowed_vlans;       // Bitmap of allowed VLANs for trunk/hybrid
+    uint64_t allowed_vlans[VLAN_MAX_COUNT / 64]; // Bitmap of allowed VLANs for trunk/hybrid
+    bool accept_untagged;         // Accept untagged frames
+    bool accept_tagged;           // Accept tagged frames
+    bool ingress_filter;          // Drop tagged frames for VLANs the port is not a member of
+    vlan_qinq_mode_t qinq_mode;   // 802.1ad role of the port
+    vlan_id_t *s_vlan_map;        // C-VID to S-VID table for customer edge ports, NULL if empty
+    vlan_id_t *ingress_xlate;     // Received VID to VLAN table, NULL if empty
+    vlan_id_t *egress_xlate;      // VLAN to transmitted VID table, NULL if empty
 } port_vlan_config_t;
 
+/**
+ * @brief Per-port ingress classification record
+ *
+ * Immutable once published. Writers rebuild it under the VLAN lock and
+ * swap the pointer; the forwarding path reads it inside an RCU read
+ * section without taking the lock.
+ *
+ * With CONFIG_NUMA_REPLICATE_TABLES on a NUMA host the published record
+ * carries a copy of itself in the memory of every other node, and readers
+ * use the one of their node.
+ */
+typedef struct vlan_port_class {
+    port_vlan_mode_t mode;        // Port VLAN mode
+    vlan_id_t pvid;               // VLAN assigned to untagged frames
+    bool accept_untagged;         // Accept untagged frames
+    bool accept_tagged;           // Accept tagged frames
+    vlan_qinq_mode_t qinq_mode;   // 802.1ad role of the port
+    bool has_vid_map;             // vid_map is present
+    uint64_t tagged_vlans[VLAN_MAX_COUNT / 64]; // VLANs accepted in tagged frames (S-VLANs on customer ports)
+    rcu_head_t rcu;               // Deferred free after replacement
+#if CONFIG_NUMA_REPLICATE_TABLES
+    size_t size;                  // Bytes of the record
+    struct vlan_port_class *node_copy[CONFIG_NUMA_MAX_NODES]; // Copy for each node, NULL to use this one
+#endif
+    vlan_id_t vid_map[];          // Received VID to VLAN: S-VLAN table on customer ports, else ingress translation
+} vlan_port_class_t;
+
 /**
  * @brief VLAN global state structure
  */
@@ -75,10 +131,24 @@ typedef struct {
     port_vlan_config_t *port_configs; // Array of port VLAN configs
     uint32_t num_ports;              // Number of ports in the system
     vlan_id_t max_vlan_id;           // Maximum VLAN ID supported
+    uint64_t stp_forwarding[VLAN_PORT_WORDS]; // Ports STP allows to forward
+    uint64_t link_up[VLAN_PORT_WORDS];        // Ports with link up
+    uint64_t qinq_provider[VLAN_PORT_WORDS];  // Provider network ports (S-tagged egress)
+    vlan_port_class_t *port_class[CONFIG_MAX_PORTS]; // Published ingress classification (RCU)
+    stats_shard_set_t *counters;     // Traffic counters, VLAN_CTR_WORDS per VLAN
     spinlock_t lock;                 // Lock for thread-safe access    
 } vlan_state_t;
 
-static vlan_state_t g_vlan_state;
+/**
+ * @brief VLAN state of each switch instance
+ *
+ * Instance 0 is static; vlan_init() allocates the others.
+ */
+static vlan_state_t g_vlan_state_default;
+static vlan_state_t *g_vlan_states[CONFIG_MAX_SWITCH_INSTANCES] = { &g_vlan_state_default };
+
+/* State of the instance the calling thread is bound to */
+#define g_vlan_state (*g_vlan_states[switch_context_current()])
 
 static inline void vlan_acquire_lock(void) {
     spinlock_acquire(&g_vlan_state.lock);
@@ -88,6 +158,28 @@ static inline void vlan_release_lock(void) {
     spinlock_release(&g_vlan_state.lock);
 }
 
+/**
+ * @brief End of the port IDs with VLAN state: physical ports, then the LAGs
+ */
+#define VLAN_PORT_END (CONFIG_LAG_PORT_BASE + CONFIG_MAX_LAGS)
+
+/**
+ * @brief Check if a port ID is a physical port of the module or a LAG
+ */
+static inline bool vlan_port_valid(port_id_t port_id) {
+    return (port_is_valid(port_id) && port_id < g_vlan_state.num_ports) || lag_port_is_lag(port_id);
+}
+
+/**
+ * @brief Port ID after i in a walk over the ports with VLAN state
+ *
+ * for (i = 0; i < VLAN_PORT_END; i = vlan_port_next(i)) visits the
+ * physical ports and then jumps to the LAGs.
+ */
+static inline uint32_t vlan_port_next(uint32_t i) {
+    return i + 1 == g_vlan_state.num_ports ? CONFIG_LAG_PORT_BASE : i + 1;
+}
+
 
 /**
  * @brief Check if a VLAN ID is valid
@@ -100,34 +192,184 @@ static bool is_vlan_id_valid(vlan_id_t vlan_id) {
 }
 
 /**
- * @brief Set bit in a bitmap
+ * @brief Recompute the flood mask of a VLAN
+ *
+ * Must be called with the VLAN lock held whenever the VLAN's membership
+ * or a port's forwarding/link state changes.
+ *
+ * @param vlan VLAN entry to refresh
+ */
+static void vlan_refresh_flood_ports(vlan_internal_entry_t *vlan) {
+    if (vlan->active) {
+        bitmap_and3(vlan->flood_ports, vlan->port_membership, g_vlan_state.stp_forwarding,
+                    g_vlan_state.link_up, VLAN_PORT_WORDS);
+    } else {
+        bitmap_zero(vlan->flood_ports, VLAN_PORT_WORDS);
+    }
+}
+
+/**
+ * @brief RCU destructor for a replaced classification record
+ *
+ * @param head RCU header embedded in the record
+ */
+static void vlan_port_class_free(rcu_head_t *head) {
+    vlan_port_class_t *cls = (vlan_port_class_t *)((char *)head - offsetof(vlan_port_class_t, rcu));
+
+#if CONFIG_NUMA_REPLICATE_TABLES
+    for (uint32_t n = 0; n < CONFIG_NUMA_MAX_NODES; n++) {
+        sim_numa_free(cls->node_copy[n], cls->size);
+    }
+#endif
+    mem_free(MEM_TAG_VLAN, cls);
+}
+
+#if CONFIG_NUMA_REPLICATE_TABLES
+/**
+ * @brief Give a classification record a copy on every other NUMA node
+ *
+ * Nodes whose copy cannot be allocated read the record itself.
+ *
+ * @param cls Record, not published yet
+ * @param size Bytes of the record
+ */
+static void vlan_port_class_replicate(vlan_port_class_t *cls, size_t size) {
+    uint32_t home = sim_numa_current_node();
+
+    cls->size = size;
+    if (!sim_numa_replicate_tables()) {
+        return;
+    }
+
+    for (uint32_t n = 0; n < sim_numa_node_count(); n++) {
+        vlan_port_class_t *copy;
+
+        if (n == home || (copy = (vlan_port_class_t *)sim_numa_alloc(size, n)) == NULL) {
+            continue;
+        }
+        memcpy(copy, cls, size);
+        memset(copy->node_copy, 0, sizeof(copy->node_copy));
+        cls->node_copy[n] = copy;
+    }
+}
+#endif
+
+/**
+ * @brief Rebuild and publish the classification record of a port
+ *
+ * Must be called with the VLAN lock held after any change to the port's
+ * mode, PVID, accept flags, allowed VLANs, VLAN membership or QinQ
+ * settings. If the new record cannot be allocated the previous one stays
+ * published.
+ *
+ * @param port_id Port ID
+ */
+static void vlan_publish_port_class(port_id_t port_id) {
+    const port_vlan_config_t *config = &g_vlan_state.port_configs[port_id];
+    bool customer = (config->qinq_mode == VLAN_QINQ_CUSTOMER);
+    const vlan_id_t *vid_map = customer ? config->s_vlan_map : config->ingress_xlate;
+    size_t map_size = (customer || vid_map) ? VLAN_MAX_COUNT * sizeof(vlan_id_t) : 0;
+    vlan_port_class_t *cls;
+    vlan_port_class_t *old;
+    uint32_t vid;
+
+    cls = (vlan_port_class_t *)mem_calloc(MEM_TAG_VLAN, 1, sizeof(vlan_port_class_t) + map_size);
+    if (!cls) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Failed to publish classification for port %d", port_id);
+        return;
+    }
+
+    cls->mode = config->mode;
+    cls->pvid = (config->mode == PORT_VLAN_MODE_ACCESS) ? config->access_vlan : config->native_vlan;
+    cls->accept_untagged = config->accept_untagged;
+    cls->accept_tagged = config->accept_tagged;
+    cls->qinq_mode = config->qinq_mode;
+    cls->has_vid_map = (map_size != 0);
+    if (vid_map) {
+        memcpy(cls->vid_map, vid_map, map_size);
+    }
+
+    if (customer) {
+        // C-tags map to S-VLANs the port belongs to, whatever its 802.1Q mode
+        for (vid = 1; vid < VLAN_MAX_COUNT; vid++) {
+            const vlan_internal_entry_t *vlan = &g_vlan_state.vlans[vid];
+
+            if (vlan->active && (!config->ingress_filter || bitmap_test(vlan->port_membership, port_id))) {
+                bitmap_set(cls->tagged_vlans, vid);
+            }
+        }
+    } else if (config->mode != PORT_VLAN_MODE_ACCESS) {
+        // Access ports never accept tagged frames
+        for (vid = 1; vid < VLAN_MAX_COUNT; vid++) {
+            const vlan_internal_entry_t *vlan = &g_vlan_state.vlans[vid];
+
+            if (!vlan->active) {
+                continue;
+            }
+            if (config->ingress_filter && !bitmap_test(vlan->port_membership, port_id)) {
+                continue;
+            }
+            if (config->mode == PORT_VLAN_MODE_TRUNK && !bitmap_test(config->allowed_vlans, vid)) {
+                continue;
+            }
+            bitmap_set(cls->tagged_vlans, vid);
+        }
+    }
+
+#if CONFIG_NUMA_REPLICATE_TABLES
+    vlan_port_class_replicate(cls, sizeof(vlan_port_class_t) + map_size);
+#endif
+
+    old = __atomic_exchange_n(&g_vlan_state.port_class[port_id], cls, __ATOMIC_SEQ_CST);
+    if (old) {
+        rcu_retire(&old->rcu, vlan_port_class_free);
+    }
+}
+
+/**
+ * @brief Rebuild and publish the classification records of all ports
  *
- * @param bitmap Bitmap to modify
- * @param bit Bit position to set
+ * Must be called with the VLAN lock held.
  */
-static void set_bitmap_bit(uint8_t *bitmap, uint32_t bit) {
-    bitmap[bit / 8] |= (1 << (bit % 8));
+static void vlan_publish_all_port_classes(void) {
+    uint32_t i;
+
+    for (i = 0; i < VLAN_PORT_END; i = vlan_port_next(i)) {
+        vlan_publish_port_class(i);
+    }
 }
 
 /**
- * @brief Clear bit in a bitmap
+ * @brief Republish the ports whose classification depends on VLAN existence
  *
- * @param bitmap Bitmap to modify
- * @param bit Bit position to clear
+ * Creating a VLAN with no members only changes what trunk, hybrid and
+ * customer edge ports without ingress filtering accept. Must be called with the VLAN
+ * lock held.
  */
-static void clear_bitmap_bit(uint8_t *bitmap, uint32_t bit) {
-    bitmap[bit / 8] &= ~(1 << (bit % 8));
+static void vlan_publish_unfiltered_port_classes(void) {
+    uint32_t i;
+
+    for (i = 0; i < VLAN_PORT_END; i = vlan_port_next(i)) {
+        const port_vlan_config_t *config = &g_vlan_state.port_configs[i];
+
+        if ((config->mode != PORT_VLAN_MODE_ACCESS || config->qinq_mode == VLAN_QINQ_CUSTOMER) &&
+            !config->ingress_filter) {
+            vlan_publish_port_class(i);
+        }
+    }
 }
 
 /**
- * @brief Test bit in a bitmap
+ * @brief Recompute the flood masks of all VLANs
  *
- * @param bitmap Bitmap to test
- * @param bit Bit position to test
- * @return bool True if bit is set, false otherwise
+ * Must be called with the VLAN lock held.
  */
-static bool test_bitmap_bit(const uint8_t *bitmap, uint32_t bit) {
-    return (bitmap[bit / 8] & (1 << (bit % 8))) != 0;
+static void vlan_refresh_all_flood_ports(void) {
+    uint32_t i;
+
+    for (i = 0; i < VLAN_MAX_COUNT; i++) {
+        vlan_refresh_flood_ports(&g_vlan_state.vlans[i]);
+    }
 }
 
 
@@ -143,23 +385,14 @@ static bool test_bitmap_bit(const uint8_t *bitmap, uint32_t bit) {
 static void vlan_internal_to_external(const vlan_internal_entry_t *internal, 
                                      vlan_entry_t *external,
                                      uint32_t port_count) {
-    uint32_t i;
-    
     external->vlan_id = internal->vlan_id;
     strncpy(external->name, internal->name, VLAN_NAME_MAX_LEN);
     external->is_active = internal->active;
-    external->member_ports = 0;
-    external->untagged_ports = 0;
     
-    // Convert bitmap to uint64_t
-    for (i = 0; i < port_count && i < 64; i++) {
-        if (test_bitmap_bit(internal->port_membership, i)) {
-            external->member_ports |= (1ULL << i);
-        }
-        if (test_bitmap_bit(internal->untagged_ports, i)) {
-            external->untagged_ports |= (1ULL << i);
-        }
-    }
+    // The external entry only carries the first 64 ports
+    (void)port_count;
+    external->member_ports = internal->port_membership[0];
+    external->untagged_ports = internal->untagged_ports[0];
     
     // Note: learning_enabled and stp_enabled might need to come from elsewhere
     // as they're not in the internal structure
@@ -176,9 +409,18 @@ static void vlan_internal_to_external(const vlan_internal_entry_t *internal,
  * @return status_t Status code
  */
 status_t vlan_init(uint32_t num_ports) {
-    uint32_t bitmap_size;
+    uint32_t instance = switch_context_current();
     uint32_t i;
     
+    if (g_vlan_states[instance] == NULL) {
+        g_vlan_states[instance] = (vlan_state_t *)mem_calloc(MEM_TAG_VLAN, 1, sizeof(vlan_state_t));
+        if (!g_vlan_states[instance]) {
+            LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Failed to allocate state of switch instance %u", instance);
+            return STATUS_MEMORY_ALLOCATION_FAILED;
+        }
+    }
+    spinlock_set_class(&g_vlan_state.lock, "vlan");
+    
     vlan_acquire_lock();
     
     if (g_vlan_state.initialized) {
@@ -187,76 +429,82 @@ status_t vlan_init(uint32_t num_ports) {
         return STATUS_ALREADY_INITIALIZED;
     }
     
-    if (num_ports == 0) {
+    if (num_ports == 0 || num_ports > CONFIG_LAG_PORT_BASE) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid number of ports");
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
     }
     
     // Allocate VLAN entries
-    g_vlan_state.vlans = (vlan_internal_entry_t *)calloc(VLAN_MAX_COUNT, sizeof(vlan_internal_entry_t));
+    g_vlan_state.vlans = (vlan_internal_entry_t *)mem_calloc(MEM_TAG_VLAN, VLAN_MAX_COUNT, sizeof(vlan_internal_entry_t));
     if (!g_vlan_state.vlans) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Failed to allocate VLAN entries");
         vlan_release_lock();
         return  STATUS_MEMORY_ALLOCATION_FAILED;
     }
     
-    // Calculate bitmap size in bytes (ceiling of num_ports / 8)
-    bitmap_size = (num_ports + 7) / 8;
-    
-    // Initialize each VLAN entry
-    for (i = 0; i < VLAN_MAX_COUNT; i++) {
-        g_vlan_state.vlans[i].vlan_id = i;
-        g_vlan_state.vlans[i].active = false;
-        strncpy(g_vlan_state.vlans[i].name, "", VLAN_NAME_MAX_LEN);
-        
-        g_vlan_state.vlans[i].port_membership = (uint8_t *)calloc(bitmap_size, sizeof(uint8_t));
-        g_vlan_state.vlans[i].untagged_ports = (uint8_t *)calloc(bitmap_size, sizeof(uint8_t));
-        
-        if (!g_vlan_state.vlans[i].port_membership || !g_vlan_state.vlans[i].untagged_ports) {
-            LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Failed to allocate bitmaps for VLAN %d", i);
-            vlan_release_lock();
-            return STATUS_MEMORY_ALLOCATION_FAILED;
-        }
+    // Counter sets are a process-wide resource; only the own switch counts
+    if (instance == SWITCH_INSTANCE_DEFAULT &&
+        stats_shard_create(VLAN_MAX_COUNT * VLAN_CTR_WORDS, &g_vlan_state.counters) != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Failed to allocate VLAN counters");
+        mem_free(MEM_TAG_VLAN, g_vlan_state.vlans);
+        g_vlan_state.vlans = NULL;
+        vlan_release_lock();
+        return STATUS_MEMORY_ALLOCATION_FAILED;
     }
     
+    // The table is left as calloc gave it: fresh zero pages that are only
+    // touched as VLANs are created, which set their own vlan_id
+    
     // Allocate port VLAN configs
-    g_vlan_state.port_configs = (port_vlan_config_t *)calloc(num_ports, sizeof(port_vlan_config_t));
+    g_vlan_state.port_configs = (port_vlan_config_t *)mem_calloc(MEM_TAG_VLAN, VLAN_PORT_END, sizeof(port_vlan_config_t));
     if (!g_vlan_state.port_configs) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Failed to allocate port configs");
+        stats_shard_destroy(g_vlan_state.counters);
+        g_vlan_state.counters = NULL;
+        mem_free(MEM_TAG_VLAN, g_vlan_state.vlans);
+        g_vlan_state.vlans = NULL;
         vlan_release_lock();
         return STATUS_MEMORY_ALLOCATION_FAILED;
     }
     
-    // Initialize each port VLAN config
-    for (i = 0; i < num_ports; i++) {
+    // Initialize each port VLAN config, LAGs included
+    for (i = 0; i < VLAN_PORT_END; i++) {
         g_vlan_state.port_configs[i].mode = PORT_VLAN_MODE_ACCESS;
         g_vlan_state.port_configs[i].access_vlan = VLAN_DEFAULT_ID;
         g_vlan_state.port_configs[i].native_vlan = VLAN_DEFAULT_ID;
         
-        g_vlan_state.port_configs[i].allowed_vlans = (uint8_t *)calloc(bitmap_size, sizeof(uint8_t));
-        if (!g_vlan_state.port_configs[i].allowed_vlans) {
-            LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Failed to allocate allowed VLANs bitmap for port %d", i);
-            vlan_release_lock();
-            return STATUS_MEMORY_ALLOCATION_FAILED;
-        }
-        
         // By default, allow all VLANs on trunk ports
-        memset(g_vlan_state.port_configs[i].allowed_vlans, 0xFF, bitmap_size);
+        memset(g_vlan_state.port_configs[i].allowed_vlans, 0xFF,
+               sizeof(g_vlan_state.port_configs[i].allowed_vlans));
+        g_vlan_state.port_configs[i].accept_untagged = true;
+        g_vlan_state.port_configs[i].accept_tagged = true;
+        g_vlan_state.port_configs[i].ingress_filter = true;
+    }
+    
+    // Until STP or the link layer says otherwise every port can forward
+    bitmap_fill(g_vlan_state.stp_forwarding, VLAN_PORT_WORDS, num_ports);
+    bitmap_fill(g_vlan_state.link_up, VLAN_PORT_WORDS, num_ports);
+    
+    // A LAG's links are its members', which the LAG module picks per frame
+    for (i = CONFIG_LAG_PORT_BASE; i < VLAN_PORT_END; i++) {
+        bitmap_set(g_vlan_state.stp_forwarding, i);
+        bitmap_set(g_vlan_state.link_up, i);
     }
     
     // Create default VLAN 1
+    g_vlan_state.vlans[VLAN_DEFAULT_ID].vlan_id = VLAN_DEFAULT_ID;
     g_vlan_state.vlans[VLAN_DEFAULT_ID].active = true;
     strncpy(g_vlan_state.vlans[VLAN_DEFAULT_ID].name, "default", VLAN_NAME_MAX_LEN);
     
     // Add all ports to default VLAN as untagged
-    for (i = 0; i < num_ports; i++) {
-        set_bitmap_bit(g_vlan_state.vlans[VLAN_DEFAULT_ID].port_membership, i);
-        set_bitmap_bit(g_vlan_state.vlans[VLAN_DEFAULT_ID].untagged_ports, i);
-    }
+    bitmap_fill(g_vlan_state.vlans[VLAN_DEFAULT_ID].port_membership, VLAN_PORT_WORDS, num_ports);
+    bitmap_fill(g_vlan_state.vlans[VLAN_DEFAULT_ID].untagged_ports, VLAN_PORT_WORDS, num_ports);
+    vlan_refresh_flood_ports(&g_vlan_state.vlans[VLAN_DEFAULT_ID]);
     
     g_vlan_state.num_ports = num_ports;
     g_vlan_state.max_vlan_id = VLAN_MAX_COUNT - 1;
+    vlan_publish_all_port_classes();
     g_vlan_state.initialized = true;
     
     LOG_INFO(LOG_CATEGORY_L2, "VLAN: Module initialized with %d ports", num_ports);
@@ -271,8 +519,14 @@ status_t vlan_init(uint32_t num_ports) {
  * @return status_t Status code
  */
 status_t vlan_cleanup(void) {
+    uint32_t instance = switch_context_current();
     uint32_t i;
     
+    if (g_vlan_states[instance] == NULL) {
+        LOG_WARNING(LOG_CATEGORY_L2, "VLAN: Module not initialized");
+        return ERROR_NOT_INITIALIZED;
+    }
+    
     vlan_acquire_lock();
     
     if (!g_vlan_state.initialized) {
@@ -281,26 +535,24 @@ status_t vlan_cleanup(void) {
         return ERROR_NOT_INITIALIZED;
     }
     
-    // Free VLAN bitmaps
-    for (i = 0; i < VLAN_MAX_COUNT; i++) {
-        if (g_vlan_state.vlans[i].port_membership) {
-            free(g_vlan_state.vlans[i].port_membership);
-        }
-        if (g_vlan_state.vlans[i].untagged_ports) {
-            free(g_vlan_state.vlans[i].untagged_ports);
+    // Unpublish classification records and wait for readers to drop them
+    for (i = 0; i < VLAN_PORT_END; i = vlan_port_next(i)) {
+        vlan_port_class_t *cls = __atomic_exchange_n(&g_vlan_state.port_class[i], NULL, __ATOMIC_SEQ_CST);
+        if (cls) {
+            rcu_retire(&cls->rcu, vlan_port_class_free);
         }
     }
+    rcu_synchronize();
     
-    // Free port VLAN configs
-    for (i = 0; i < g_vlan_state.num_ports; i++) {
-        if (g_vlan_state.port_configs[i].allowed_vlans) {
-            free(g_vlan_state.port_configs[i].allowed_vlans);
-        }
+    // Free main structures (bitmaps are embedded in the entries)
+    for (i = 0; i < VLAN_PORT_END; i = vlan_port_next(i)) {
+        mem_free(MEM_TAG_VLAN, g_vlan_state.port_configs[i].s_vlan_map);
+        mem_free(MEM_TAG_VLAN, g_vlan_state.port_configs[i].ingress_xlate);
+        mem_free(MEM_TAG_VLAN, g_vlan_state.port_configs[i].egress_xlate);
     }
-    
-    // Free main structures
-    free(g_vlan_state.vlans);
-    free(g_vlan_state.port_configs);
+    mem_free(MEM_TAG_VLAN, g_vlan_state.vlans);
+    mem_free(MEM_TAG_VLAN, g_vlan_state.port_configs);
+    stats_shard_destroy(g_vlan_state.counters);
     
     // Reset global state
     memset(&g_vlan_state, 0, sizeof(vlan_state_t));
@@ -308,9 +560,23 @@ status_t vlan_cleanup(void) {
     LOG_INFO(LOG_CATEGORY_L2, "VLAN: Module cleaned up");
     
     vlan_release_lock();
+    
+    if (instance != SWITCH_INSTANCE_DEFAULT) {
+        mem_free(MEM_TAG_VLAN, g_vlan_states[instance]);
+        g_vlan_states[instance] = NULL;
+    }
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Deinitialize the VLAN module, see vlan_cleanup()
+ *
+ * @return status_t Status code
+ */
+status_t vlan_deinit(void) {
+    return vlan_cleanup();
+}
+
 
 
 
@@ -388,11 +654,13 @@ status_t vlan_create(vlan_id_t vlan_id, const char *vlan_name) {
     }
     
     // Set up the VLAN
+    g_vlan_state.vlans[vlan_id].vlan_id = vlan_id;
     g_vlan_state.vlans[vlan_id].active = true;
     
     // Clear any existing membership
-    memset(g_vlan_state.vlans[vlan_id].port_membership, 0, (g_vlan_state.num_ports + 7) / 8);
-    memset(g_vlan_state.vlans[vlan_id].untagged_ports, 0, (g_vlan_state.num_ports + 7) / 8);
+    memset(g_vlan_state.vlans[vlan_id].port_membership, 0, sizeof(g_vlan_state.vlans[vlan_id].port_membership));
+    memset(g_vlan_state.vlans[vlan_id].untagged_ports, 0, sizeof(g_vlan_state.vlans[vlan_id].untagged_ports));
+    vlan_refresh_flood_ports(&g_vlan_state.vlans[vlan_id]);
     
     // Set VLAN name if provided
     if (vlan_name && strlen(vlan_name) > 0) {
@@ -402,6 +670,8 @@ status_t vlan_create(vlan_id_t vlan_id, const char *vlan_name) {
         snprintf(g_vlan_state.vlans[vlan_id].name, VLAN_NAME_MAX_LEN, "VLAN%d", vlan_id);
     }
     
+    vlan_publish_unfiltered_port_classes();
+    
     LOG_INFO(LOG_CATEGORY_L2, "VLAN: Created VLAN %d '%s'", vlan_id, g_vlan_state.vlans[vlan_id].name);
     
     vlan_release_lock();
@@ -445,15 +715,15 @@ status_t vlan_delete(vlan_id_t vlan_id) {
     }
     
     // Update port configurations that use this VLAN
-    for (i = 0; i < g_vlan_state.num_ports; i++) {
+    for (i = 0; i < VLAN_PORT_END; i = vlan_port_next(i)) {
         // If port is using this VLAN as access VLAN, move it to default VLAN
         if (g_vlan_state.port_configs[i].access_vlan == vlan_id) {
             LOG_INFO(LOG_CATEGORY_L2, "VLAN: Port %d moved from deleted VLAN %d to default VLAN", i, vlan_id);
             g_vlan_state.port_configs[i].access_vlan = VLAN_DEFAULT_ID;
             
             // Add port to default VLAN
-            set_bitmap_bit(g_vlan_state.vlans[VLAN_DEFAULT_ID].port_membership, i);
-            set_bitmap_bit(g_vlan_state.vlans[VLAN_DEFAULT_ID].untagged_ports, i);
+            bitmap_set(g_vlan_state.vlans[VLAN_DEFAULT_ID].port_membership, i);
+            bitmap_set(g_vlan_state.vlans[VLAN_DEFAULT_ID].untagged_ports, i);
         }
         
         // If port is using this VLAN as native VLAN, move it to default VLAN
@@ -463,16 +733,25 @@ status_t vlan_delete(vlan_id_t vlan_id) {
         }
         
         // Remove this VLAN from allowed VLANs on trunk ports
-        clear_bitmap_bit(g_vlan_state.port_configs[i].allowed_vlans, vlan_id);
+        bitmap_clear(g_vlan_state.port_configs[i].allowed_vlans, vlan_id);
+
+        // Drop egress translation so a recreated VLAN starts clean
+        if (g_vlan_state.port_configs[i].egress_xlate) {
+            g_vlan_state.port_configs[i].egress_xlate[vlan_id] = VLAN_ID_INVALID;
+        }
     }
+    memset(g_vlan_state.vlans[vlan_id].egress_xlate_ports, 0, sizeof(g_vlan_state.vlans[vlan_id].egress_xlate_ports));
     
     // Mark VLAN as inactive
     g_vlan_state.vlans[vlan_id].active = false;
     strncpy(g_vlan_state.vlans[vlan_id].name, "", VLAN_NAME_MAX_LEN);
     
     // Clear all port memberships
-    memset(g_vlan_state.vlans[vlan_id].port_membership, 0, (g_vlan_state.num_ports + 7) / 8);
-    memset(g_vlan_state.vlans[vlan_id].untagged_ports, 0, (g_vlan_state.num_ports + 7) / 8);
+    memset(g_vlan_state.vlans[vlan_id].port_membership, 0, sizeof(g_vlan_state.vlans[vlan_id].port_membership));
+    memset(g_vlan_state.vlans[vlan_id].untagged_ports, 0, sizeof(g_vlan_state.vlans[vlan_id].untagged_ports));
+    vlan_refresh_flood_ports(&g_vlan_state.vlans[vlan_id]);
+    vlan_refresh_flood_ports(&g_vlan_state.vlans[VLAN_DEFAULT_ID]);
+    vlan_publish_all_port_classes();
     
     LOG_INFO(LOG_CATEGORY_L2, "VLAN: Deleted VLAN %d", vlan_id);
     
@@ -488,61 +767,81 @@ status_t vlan_delete(vlan_id_t vlan_id) {
 
 
 /**
- * @brief Add a port to a VLAN
+ * @brief Add a port to a VLAN with the lock held
+ *
+ * Changes the membership only; the caller refreshes the VLAN's flood set
+ * and republishes the port's classification.
  *
  * @param vlan_id VLAN ID
  * @param port_id Port ID
  * @param member_type Type of VLAN membership (tagged or untagged)
  * @return status_t Status code
  */
-status_t vlan_add_port(vlan_id_t vlan_id, port_id_t port_id, vlan_member_type_t member_type) {
-    vlan_acquire_lock();
-
-    if (!g_vlan_state.initialized) {
-        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
-        vlan_release_lock();
-        return ERROR_NOT_INITIALIZED;
-    }
-
+static status_t vlan_add_port_locked(vlan_id_t vlan_id, port_id_t port_id, vlan_member_type_t member_type) {
     if (!is_vlan_id_valid(vlan_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid VLAN ID %d", vlan_id);
-        vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
     }
 
     if (!g_vlan_state.vlans[vlan_id].active) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: VLAN %d does not exist", vlan_id);
-        vlan_release_lock();
         return STATUS_NOT_FOUND;
     }
 
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
-        vlan_release_lock();
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (member_type != VLAN_MEMBER_TAGGED && member_type != VLAN_MEMBER_UNTAGGED) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid member type for port %d, VLAN %d", port_id, vlan_id);
         return ERROR_INVALID_PARAMETER;
     }
 
     // Add port to VLAN membership
-    set_bitmap_bit(g_vlan_state.vlans[vlan_id].port_membership, port_id);
+    bitmap_set(g_vlan_state.vlans[vlan_id].port_membership, port_id);
 
     // Set tagging mode for port based on member_type
     if (member_type == VLAN_MEMBER_TAGGED) {
-        clear_bitmap_bit(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
+        bitmap_clear(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
         LOG_INFO(LOG_CATEGORY_L2, "VLAN: Added port %d to VLAN %d as tagged", port_id, vlan_id);
-    } else if (member_type == VLAN_MEMBER_UNTAGGED) {
-        set_bitmap_bit(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
-        LOG_INFO(LOG_CATEGORY_L2, "VLAN: Added port %d to VLAN %d as untagged", port_id, vlan_id);
     } else {
-        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid member type for port %d, VLAN %d", port_id, vlan_id);
-        vlan_release_lock();
-        return ERROR_INVALID_PARAMETER;
+        bitmap_set(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
+        LOG_INFO(LOG_CATEGORY_L2, "VLAN: Added port %d to VLAN %d as untagged", port_id, vlan_id);
     }
 
     // Add VLAN to allowed VLANs for this port
-    set_bitmap_bit(g_vlan_state.port_configs[port_id].allowed_vlans, vlan_id);
+    bitmap_set(g_vlan_state.port_configs[port_id].allowed_vlans, vlan_id);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Add a port to a VLAN
+ *
+ * @param vlan_id VLAN ID
+ * @param port_id Port ID
+ * @param member_type Type of VLAN membership (tagged or untagged)
+ * @return status_t Status code
+ */
+status_t vlan_add_port(vlan_id_t vlan_id, port_id_t port_id, vlan_member_type_t member_type) {
+    status_t status;
+
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    status = vlan_add_port_locked(vlan_id, port_id, member_type);
+    if (status == STATUS_SUCCESS) {
+        vlan_refresh_flood_ports(&g_vlan_state.vlans[vlan_id]);
+        vlan_publish_port_class(port_id);
+    }
 
     vlan_release_lock();
-    return STATUS_SUCCESS;
+    return status;
 }
 
 
@@ -550,6 +849,7 @@ status_t vlan_add_port(vlan_id_t vlan_id, port_id_t port_id, vlan_member_type_t
 
 
 
+
 ///**
 // * @brief Add a port to a VLAN
 // *
@@ -579,62 +879,53 @@ status_t vlan_add_port(vlan_id_t vlan_id, port_id_t port_id, vlan_member_type_t
 //        return STATUS_NOT_FOUND;
 //    }
 //    
-//    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+//    if (!vlan_port_valid(port_id)) {
 //        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
 //        vlan_release_lock();
 //        return ERROR_INVALID_PARAMETER;
 //    }
 //    
 //    // Add port to VLAN membership
-//    set_bitmap_bit(g_vlan_state.vlans[vlan_id].port_membership, port_id);
+//    bitmap_set(g_vlan_state.vlans[vlan_id].port_membership, port_id);
 //    
 //    // Set tagging mode for port
 //    if (tagged) {
-//        clear_bitmap_bit(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
+//        bitmap_clear(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
 //        LOG_INFO(LOG_CATEGORY_L2, "VLAN: Added port %d to VLAN %d as tagged", port_id, vlan_id);
 //    } else {
-//        set_bitmap_bit(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
+//        bitmap_set(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
 //        LOG_INFO(LOG_CATEGORY_L2, "VLAN: Added port %d to VLAN %d as untagged", port_id, vlan_id);
 //    }
 //    
 //    // Add VLAN to allowed VLANs for this port
-//    set_bitmap_bit(g_vlan_state.port_configs[port_id].allowed_vlans, vlan_id);
+//    bitmap_set(g_vlan_state.port_configs[port_id].allowed_vlans, vlan_id);
 //    
 //    vlan_release_lock();
 //    return STATUS_SUCCESS;
 //}
 
 /**
- * @brief Remove a port from a VLAN
+ * @brief Remove a port from a VLAN with the lock held
+ *
+ * Changes the membership only, as vlan_add_port_locked().
  *
  * @param vlan_id VLAN ID
  * @param port_id Port ID
  * @return status_t Status code
  */
-status_t vlan_remove_port(vlan_id_t vlan_id, port_id_t port_id) {
-    vlan_acquire_lock();
-    
-    if (!g_vlan_state.initialized) {
-        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
-        vlan_release_lock();
-        return ERROR_NOT_INITIALIZED;
-    }
-    
+static status_t vlan_remove_port_locked(vlan_id_t vlan_id, port_id_t port_id) {
     if (!is_vlan_id_valid(vlan_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid VLAN ID %d", vlan_id);
-        vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
     }
     
     if (!g_vlan_state.vlans[vlan_id].active) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: VLAN %d does not exist", vlan_id);
-        vlan_release_lock();
         return STATUS_NOT_FOUND;
     }
     
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
-        vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
     }
     
@@ -644,24 +935,50 @@ status_t vlan_remove_port(vlan_id_t vlan_id, port_id_t port_id) {
         if (g_vlan_state.port_configs[port_id].mode == PORT_VLAN_MODE_ACCESS && 
             g_vlan_state.port_configs[port_id].access_vlan == VLAN_DEFAULT_ID) {
             LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Cannot remove port %d from default VLAN while in access mode", port_id);
-            vlan_release_lock();
             return STATUS_PERMISSION_DENIED;
         }
     }
     
     // Remove port from VLAN
-    clear_bitmap_bit(g_vlan_state.vlans[vlan_id].port_membership, port_id);
-    clear_bitmap_bit(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
+    bitmap_clear(g_vlan_state.vlans[vlan_id].port_membership, port_id);
+    bitmap_clear(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
     
     // Remove VLAN from allowed VLANs for trunk ports
-    clear_bitmap_bit(g_vlan_state.port_configs[port_id].allowed_vlans, vlan_id);
+    bitmap_clear(g_vlan_state.port_configs[port_id].allowed_vlans, vlan_id);
     
     LOG_INFO(LOG_CATEGORY_L2, "VLAN: Removed port %d from VLAN %d", port_id, vlan_id);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Remove a port from a VLAN
+ *
+ * @param vlan_id VLAN ID
+ * @param port_id Port ID
+ * @return status_t Status code
+ */
+status_t vlan_remove_port(vlan_id_t vlan_id, port_id_t port_id) {
+    status_t status;
+
+    vlan_acquire_lock();
+    
+    if (!g_vlan_state.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+    
+    status = vlan_remove_port_locked(vlan_id, port_id);
+    if (status == STATUS_SUCCESS) {
+        vlan_refresh_flood_ports(&g_vlan_state.vlans[vlan_id]);
+        vlan_publish_port_class(port_id);
+    }
     
     vlan_release_lock();
-    return STATUS_SUCCESS;
+    return status;
 }
 
+
 /**
  * @brief Configure a port as an access port
  *
@@ -690,7 +1007,7 @@ status_t vlan_set_port_access_mode(port_id_t port_id, vlan_id_t vlan_id) {
         return STATUS_NOT_FOUND;
     }
     
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
@@ -701,8 +1018,9 @@ status_t vlan_set_port_access_mode(port_id_t port_id, vlan_id_t vlan_id) {
     
     // Remove port from previous access VLAN if it's different
     if (old_vlan != vlan_id && old_vlan != VLAN_INVALID_ID) {
-        clear_bitmap_bit(g_vlan_state.vlans[old_vlan].port_membership, port_id);
-        clear_bitmap_bit(g_vlan_state.vlans[old_vlan].untagged_ports, port_id);
+        bitmap_clear(g_vlan_state.vlans[old_vlan].port_membership, port_id);
+        bitmap_clear(g_vlan_state.vlans[old_vlan].untagged_ports, port_id);
+        vlan_refresh_flood_ports(&g_vlan_state.vlans[old_vlan]);
     }
     
     // Update port configuration
@@ -710,8 +1028,10 @@ status_t vlan_set_port_access_mode(port_id_t port_id, vlan_id_t vlan_id) {
     g_vlan_state.port_configs[port_id].access_vlan = vlan_id;
     
     // Add port to new access VLAN as untagged
-    set_bitmap_bit(g_vlan_state.vlans[vlan_id].port_membership, port_id);
-    set_bitmap_bit(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
+    bitmap_set(g_vlan_state.vlans[vlan_id].port_membership, port_id);
+    bitmap_set(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
+    vlan_refresh_flood_ports(&g_vlan_state.vlans[vlan_id]);
+    vlan_publish_port_class(port_id);
     
     LOG_INFO(LOG_CATEGORY_L2, "VLAN: Port %d set to access mode with VLAN %d", port_id, vlan_id);
     
@@ -735,7 +1055,7 @@ status_t vlan_set_port_trunk_mode(port_id_t port_id, vlan_id_t native_vlan) {
         return ERROR_NOT_INITIALIZED;
     }
     
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
@@ -764,8 +1084,9 @@ status_t vlan_set_port_trunk_mode(port_id_t port_id, vlan_id_t native_vlan) {
         vlan_id_t old_vlan = g_vlan_state.port_configs[port_id].access_vlan;
         
         // Remove port from previous access VLAN membership
-        clear_bitmap_bit(g_vlan_state.vlans[old_vlan].port_membership, port_id);
-        clear_bitmap_bit(g_vlan_state.vlans[old_vlan].untagged_ports, port_id);
+        bitmap_clear(g_vlan_state.vlans[old_vlan].port_membership, port_id);
+        bitmap_clear(g_vlan_state.vlans[old_vlan].untagged_ports, port_id);
+        vlan_refresh_flood_ports(&g_vlan_state.vlans[old_vlan]);
     }
     
     // Update port configuration
@@ -773,8 +1094,10 @@ status_t vlan_set_port_trunk_mode(port_id_t port_id, vlan_id_t native_vlan) {
     g_vlan_state.port_configs[port_id].native_vlan = native_vlan;
     
     // Add port to native VLAN as untagged
-    set_bitmap_bit(g_vlan_state.vlans[native_vlan].port_membership, port_id);
-    set_bitmap_bit(g_vlan_state.vlans[native_vlan].untagged_ports, port_id);
+    bitmap_set(g_vlan_state.vlans[native_vlan].port_membership, port_id);
+    bitmap_set(g_vlan_state.vlans[native_vlan].untagged_ports, port_id);
+    vlan_refresh_flood_ports(&g_vlan_state.vlans[native_vlan]);
+    vlan_publish_port_class(port_id);
     
     LOG_INFO(LOG_CATEGORY_L2, "VLAN: Port %d set to trunk mode with native VLAN %d", port_id, native_vlan);
     
@@ -783,71 +1106,151 @@ status_t vlan_set_port_trunk_mode(port_id_t port_id, vlan_id_t native_vlan) {
 }
 
 /**
- * @brief Configure allowed VLANs on a trunk port
+ * @brief Set the ingress configuration of a port in one step
+ *
+ * Membership is left to vlan_add_port(); only the mode, PVID and the
+ * acceptance and filtering rules are taken from the configuration.
  *
  * @param port_id Port ID
- * @param vlan_id VLAN ID to allow or disallow
- * @param allowed Whether the VLAN is allowed
+ * @param config Port configuration
  * @return status_t Status code
  */
-status_t vlan_set_trunk_allowed_vlan(port_id_t port_id, vlan_id_t vlan_id, bool allowed) {
+status_t vlan_set_port_config(port_id_t port_id, vlan_port_config_t *config) {
+    if (config == NULL || config->mode > VLAN_PORT_MODE_HYBRID ||
+        !is_vlan_id_valid(config->pvid) || !is_vlan_id_valid(config->native_vlan)) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
     vlan_acquire_lock();
-    
+
     if (!g_vlan_state.initialized) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
         vlan_release_lock();
         return ERROR_NOT_INITIALIZED;
     }
-    
-    if (!is_vlan_id_valid(vlan_id)) {
-        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid VLAN ID %d", vlan_id);
-        vlan_release_lock();
-        return ERROR_INVALID_PARAMETER;
-    }
 
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
     }
 
-    // Check if port is in trunk mode
-    if (g_vlan_state.port_configs[port_id].mode != PORT_VLAN_MODE_TRUNK &&
-        g_vlan_state.port_configs[port_id].mode != PORT_VLAN_MODE_HYBRID) {
-        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Port %d is not in trunk or hybrid mode", port_id);
-        vlan_release_lock();
-        return ERROR_INVALID_STATE;
-    }
-
-    // Cannot disallow native VLAN
-    if (!allowed && vlan_id == g_vlan_state.port_configs[port_id].native_vlan) {
-        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Cannot disallow native VLAN %d on port %d", vlan_id, port_id);
-        vlan_release_lock();
-        return STATUS_PERMISSION_DENIED;
-    }
-
-    if (allowed) {
-        // Add VLAN to allowed list
-        set_bitmap_bit(g_vlan_state.port_configs[port_id].allowed_vlans, vlan_id);
-        LOG_INFO(LOG_CATEGORY_L2, "VLAN: Allowed VLAN %d on trunk port %d", vlan_id, port_id);
-    } else {
-        // Remove VLAN from allowed list
-        clear_bitmap_bit(g_vlan_state.port_configs[port_id].allowed_vlans, vlan_id);
-        LOG_INFO(LOG_CATEGORY_L2, "VLAN: Disallowed VLAN %d on trunk port %d", vlan_id, port_id);
-    }
+    port_vlan_config_t *port = &g_vlan_state.port_configs[port_id];
+    port->mode = (port_vlan_mode_t)config->mode;
+    port->access_vlan = config->pvid;
+    port->native_vlan = (config->mode == VLAN_PORT_MODE_ACCESS) ? config->pvid : config->native_vlan;
+    port->accept_untagged = config->accept_untag;
+    port->accept_tagged = config->accept_tag;
+    port->ingress_filter = config->ingress_filter;
+    vlan_publish_port_class(port_id);
 
     vlan_release_lock();
     return STATUS_SUCCESS;
 }
 
 /**
- * @brief Configure a port as a hybrid port
+ * @brief Get the ingress configuration of a port
  *
  * @param port_id Port ID
- * @param native_vlan Native VLAN ID (for untagged frames)
+ * @param config Filled with the port configuration
  * @return status_t Status code
  */
-status_t vlan_set_port_hybrid_mode(port_id_t port_id, vlan_id_t native_vlan) {
+status_t vlan_get_port_config(port_id_t port_id, vlan_port_config_t *config) {
+    if (config == NULL) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    if (!vlan_port_valid(port_id)) {
+        vlan_release_lock();
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    const port_vlan_config_t *port = &g_vlan_state.port_configs[port_id];
+    config->mode = (vlan_port_mode_t)port->mode;
+    config->pvid = (port->mode == PORT_VLAN_MODE_ACCESS) ? port->access_vlan : port->native_vlan;
+    config->native_vlan = port->native_vlan;
+    config->accept_untag = port->accept_untagged;
+    config->accept_tag = port->accept_tagged;
+    config->ingress_filter = port->ingress_filter;
+
+    vlan_release_lock();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Configure allowed VLANs on a trunk port
+ *
+ * @param port_id Port ID
+ * @param vlan_id VLAN ID to allow or disallow
+ * @param allowed Whether the VLAN is allowed
+ * @return status_t Status code
+ */
+status_t vlan_set_trunk_allowed_vlan(port_id_t port_id, vlan_id_t vlan_id, bool allowed) {
+    vlan_acquire_lock();
+    
+    if (!g_vlan_state.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+    
+    if (!is_vlan_id_valid(vlan_id)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid VLAN ID %d", vlan_id);
+        vlan_release_lock();
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (!vlan_port_valid(port_id)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
+        vlan_release_lock();
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    // Check if port is in trunk mode
+    if (g_vlan_state.port_configs[port_id].mode != PORT_VLAN_MODE_TRUNK &&
+        g_vlan_state.port_configs[port_id].mode != PORT_VLAN_MODE_HYBRID) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Port %d is not in trunk or hybrid mode", port_id);
+        vlan_release_lock();
+        return ERROR_INVALID_STATE;
+    }
+
+    // Cannot disallow native VLAN
+    if (!allowed && vlan_id == g_vlan_state.port_configs[port_id].native_vlan) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Cannot disallow native VLAN %d on port %d", vlan_id, port_id);
+        vlan_release_lock();
+        return STATUS_PERMISSION_DENIED;
+    }
+
+    if (allowed) {
+        // Add VLAN to allowed list
+        bitmap_set(g_vlan_state.port_configs[port_id].allowed_vlans, vlan_id);
+        LOG_INFO(LOG_CATEGORY_L2, "VLAN: Allowed VLAN %d on trunk port %d", vlan_id, port_id);
+    } else {
+        // Remove VLAN from allowed list
+        bitmap_clear(g_vlan_state.port_configs[port_id].allowed_vlans, vlan_id);
+        LOG_INFO(LOG_CATEGORY_L2, "VLAN: Disallowed VLAN %d on trunk port %d", vlan_id, port_id);
+    }
+    vlan_publish_port_class(port_id);
+
+    vlan_release_lock();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Configure a port as a hybrid port
+ *
+ * @param port_id Port ID
+ * @param native_vlan Native VLAN ID (for untagged frames)
+ * @return status_t Status code
+ */
+status_t vlan_set_port_hybrid_mode(port_id_t port_id, vlan_id_t native_vlan) {
     vlan_acquire_lock();
 
     if (!g_vlan_state.initialized) {
@@ -856,7 +1259,7 @@ status_t vlan_set_port_hybrid_mode(port_id_t port_id, vlan_id_t native_vlan) {
         return ERROR_NOT_INITIALIZED;
     }
 
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
@@ -885,8 +1288,9 @@ status_t vlan_set_port_hybrid_mode(port_id_t port_id, vlan_id_t native_vlan) {
         vlan_id_t old_vlan = g_vlan_state.port_configs[port_id].access_vlan;
 
         // Remove port from previous access VLAN membership
-        clear_bitmap_bit(g_vlan_state.vlans[old_vlan].port_membership, port_id);
-        clear_bitmap_bit(g_vlan_state.vlans[old_vlan].untagged_ports, port_id);
+        bitmap_clear(g_vlan_state.vlans[old_vlan].port_membership, port_id);
+        bitmap_clear(g_vlan_state.vlans[old_vlan].untagged_ports, port_id);
+        vlan_refresh_flood_ports(&g_vlan_state.vlans[old_vlan]);
     }
 
     // Update port configuration
@@ -894,8 +1298,10 @@ status_t vlan_set_port_hybrid_mode(port_id_t port_id, vlan_id_t native_vlan) {
     g_vlan_state.port_configs[port_id].native_vlan = native_vlan;
 
     // Add port to native VLAN as untagged
-    set_bitmap_bit(g_vlan_state.vlans[native_vlan].port_membership, port_id);
-    set_bitmap_bit(g_vlan_state.vlans[native_vlan].untagged_ports, port_id);
+    bitmap_set(g_vlan_state.vlans[native_vlan].port_membership, port_id);
+    bitmap_set(g_vlan_state.vlans[native_vlan].untagged_ports, port_id);
+    vlan_refresh_flood_ports(&g_vlan_state.vlans[native_vlan]);
+    vlan_publish_port_class(port_id);
 
     LOG_INFO(LOG_CATEGORY_L2, "VLAN: Port %d set to hybrid mode with native VLAN %d", port_id, native_vlan);
 
@@ -932,14 +1338,14 @@ status_t vlan_set_port_tagging(port_id_t port_id, vlan_id_t vlan_id, bool tagged
         return STATUS_NOT_FOUND;
     }
 
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
     }
 
     // Check if port is a member of the VLAN
-    if (!test_bitmap_bit(g_vlan_state.vlans[vlan_id].port_membership, port_id)) {
+    if (!bitmap_test(g_vlan_state.vlans[vlan_id].port_membership, port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Port %d is not a member of VLAN %d", port_id, vlan_id);
         vlan_release_lock();
         return STATUS_NOT_FOUND;
@@ -965,10 +1371,10 @@ status_t vlan_set_port_tagging(port_id_t port_id, vlan_id_t vlan_id, bool tagged
 
     // Set tagging mode
     if (tagged) {
-        clear_bitmap_bit(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
+        bitmap_clear(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
         LOG_INFO(LOG_CATEGORY_L2, "VLAN: Port %d set to tagged in VLAN %d", port_id, vlan_id);
     } else {
-        set_bitmap_bit(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
+        bitmap_set(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
         LOG_INFO(LOG_CATEGORY_L2, "VLAN: Port %d set to untagged in VLAN %d", port_id, vlan_id);
     }
 
@@ -1005,7 +1411,7 @@ status_t vlan_is_port_member(port_id_t port_id, vlan_id_t vlan_id, bool *is_memb
         return STATUS_NOT_FOUND;
     }
 
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
@@ -1017,7 +1423,7 @@ status_t vlan_is_port_member(port_id_t port_id, vlan_id_t vlan_id, bool *is_memb
         return ERROR_INVALID_PARAMETER;
     }
 
-    *is_member = test_bitmap_bit(g_vlan_state.vlans[vlan_id].port_membership, port_id);
+    *is_member = bitmap_test(g_vlan_state.vlans[vlan_id].port_membership, port_id);
 
     vlan_release_lock();
     return STATUS_SUCCESS;
@@ -1052,7 +1458,7 @@ status_t vlan_is_port_tagged(port_id_t port_id, vlan_id_t vlan_id, bool *is_tagg
         return STATUS_NOT_FOUND;
     }
 
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
@@ -1065,14 +1471,14 @@ status_t vlan_is_port_tagged(port_id_t port_id, vlan_id_t vlan_id, bool *is_tagg
     }
 
     // Check if port is a member of the VLAN
-    if (!test_bitmap_bit(g_vlan_state.vlans[vlan_id].port_membership, port_id)) {
+    if (!bitmap_test(g_vlan_state.vlans[vlan_id].port_membership, port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Port %d is not a member of VLAN %d", port_id, vlan_id);
         vlan_release_lock();
         return STATUS_NOT_FOUND;
     }
 
     // Port is tagged if it's a member and not in the untagged ports bitmap
-    *is_tagged = !test_bitmap_bit(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
+    *is_tagged = !bitmap_test(g_vlan_state.vlans[vlan_id].untagged_ports, port_id);
 
     vlan_release_lock();
     return STATUS_SUCCESS;
@@ -1094,7 +1500,7 @@ status_t vlan_get_port_mode(port_id_t port_id, port_vlan_mode_t *mode) {
         return ERROR_NOT_INITIALIZED;
     }
 
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
@@ -1130,7 +1536,7 @@ status_t vlan_get_port_access_vlan(port_id_t port_id, vlan_id_t *vlan_id) {
         return ERROR_NOT_INITIALIZED;
     }
 
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
@@ -1170,7 +1576,7 @@ status_t vlan_get_port_native_vlan(port_id_t port_id, vlan_id_t *vlan_id) {
         return ERROR_NOT_INITIALIZED;
     }
     
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
@@ -1217,7 +1623,7 @@ status_t vlan_is_trunk_vlan_allowed(port_id_t port_id, vlan_id_t vlan_id, bool *
         return ERROR_INVALID_PARAMETER;
     }
     
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
@@ -1234,7 +1640,7 @@ status_t vlan_is_trunk_vlan_allowed(port_id_t port_id, vlan_id_t vlan_id, bool *
         LOG_WARNING(LOG_CATEGORY_L2, "VLAN: Port %d is not in trunk or hybrid mode", port_id);
         *is_allowed = false;
     } else {
-        *is_allowed = test_bitmap_bit(g_vlan_state.port_configs[port_id].allowed_vlans, vlan_id);
+        *is_allowed = bitmap_test(g_vlan_state.port_configs[port_id].allowed_vlans, vlan_id);
     }
     
     vlan_release_lock();
@@ -1247,100 +1653,222 @@ status_t vlan_is_trunk_vlan_allowed(port_id_t port_id, vlan_id_t vlan_id, bool *
 
 
 
+/**
+ * @brief Get the TPID of a packet's outer tag for classification
+ *
+ * Frames described only by metadata (no parsed stack, no tag bytes) are
+ * taken to carry an 802.1Q tag when is_tagged is set.
+ *
+ * @param packet Packet to inspect
+ * @return uint16_t ETHERTYPE_VLAN, ETHERTYPE_QINQ, or 0 if untagged
+ */
+static uint16_t vlan_outer_tpid(const packet_buffer_t *packet) {
+    uint16_t tpid;
+
+    if (!packet->metadata.is_tagged) {
+        return 0;
+    }
+    tpid = packet_vlan_tpid(packet);
+    return tpid ? tpid : ETHERTYPE_VLAN;
+}
+
+/**
+ * @brief Classify a packet against a port's published record
+ *
+ * Must be called inside an RCU read section.
+ *
+ * @param port_id Ingress port
+ * @param cls Classification record of the port
+ * @param packet Packet to classify
+ * @param vlan_id Output VLAN ID
+ * @param push_stag Output, true if the frame still needs an S-tag for vlan_id
+ * @return status_t STATUS_SUCCESS, or ERROR_INVALID_PACKET if the frame is dropped
+ */
+static status_t vlan_classify(port_id_t port_id, const vlan_port_class_t *cls, const packet_buffer_t *packet,
+                              vlan_id_t *vlan_id, bool *push_stag) {
+    uint16_t tpid = vlan_outer_tpid(packet);
+    vlan_id_t vid = packet->metadata.vlan;
+
+    *push_stag = false;
+
+    if (cls->qinq_mode == VLAN_QINQ_PROVIDER && tpid != ETHERTYPE_QINQ) {
+        // Only an S-tag is a VLAN tag here; C-tagged frames go to the native S-VLAN
+        tpid = 0;
+    } else if (cls->qinq_mode == VLAN_QINQ_CUSTOMER && tpid == ETHERTYPE_QINQ) {
+        LOG_DEBUG(LOG_CATEGORY_L2, "VLAN: Customer port %d dropped S-tagged packet", port_id);
+        return ERROR_INVALID_PACKET;
+    } else if (cls->qinq_mode == VLAN_QINQ_CUSTOMER && tpid) {
+        // C-tagged: translate the C-VID, unmapped C-VIDs share the PVID
+        if (!cls->accept_tagged) {
+            LOG_DEBUG(LOG_CATEGORY_L2, "VLAN: Port %d dropped C-tagged packet", port_id);
+            return ERROR_INVALID_PACKET;
+        }
+        vid = (vid < VLAN_MAX_COUNT && cls->vid_map[vid]) ? cls->vid_map[vid] : cls->pvid;
+        if (vid >= VLAN_MAX_COUNT || !bitmap_test(cls->tagged_vlans, vid)) {
+            LOG_DEBUG(LOG_CATEGORY_L2, "VLAN: Port %d dropped C-tagged packet for S-VLAN %d", port_id, vid);
+            return ERROR_INVALID_PACKET;
+        }
+        *vlan_id = vid;
+        *push_stag = true;
+        return STATUS_SUCCESS;
+    }
+
+    if (tpid) {
+        // One table load replaces a translation pass through the pipeline
+        if (cls->has_vid_map && vid < VLAN_MAX_COUNT && cls->vid_map[vid]) {
+            vid = cls->vid_map[vid];
+        }
+
+        // Covers invalid and nonexistent VLANs, non-members, access ports
+        // and VLANs not allowed on a trunk
+        if (!cls->accept_tagged || vid >= VLAN_MAX_COUNT || !bitmap_test(cls->tagged_vlans, vid)) {
+            LOG_DEBUG(LOG_CATEGORY_L2, "VLAN: Port %d dropped tagged packet for VLAN %d", port_id, vid);
+            return ERROR_INVALID_PACKET;
+        }
+        *vlan_id = vid;
+        return STATUS_SUCCESS;
+    }
+
+    if (!cls->accept_untagged) {
+        LOG_DEBUG(LOG_CATEGORY_L2, "VLAN: Port %d dropped untagged packet", port_id);
+        return ERROR_INVALID_PACKET;
+    }
+    *vlan_id = cls->pvid;
+    *push_stag = (cls->qinq_mode != VLAN_QINQ_NONE);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Load the published classification record of a port
+ *
+ * On success the caller is inside an RCU read section and must call
+ * rcu_read_unlock() when done with the record.
+ *
+ * @param port_id Port ID
+ * @param cls Output record
+ * @return status_t Status code
+ */
+static status_t vlan_port_class_get(port_id_t port_id, const vlan_port_class_t **cls) {
+    if (port_id >= CONFIG_MAX_PORTS) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (rcu_read_lock() != STATUS_SUCCESS) {
+        return STATUS_NO_MEMORY;
+    }
+
+    *cls = __atomic_load_n(&g_vlan_state.port_class[port_id], __ATOMIC_SEQ_CST);
+    if (!*cls) {
+        // Module not initialized or port beyond the configured count
+        rcu_read_unlock();
+        return g_vlan_state.initialized ? ERROR_INVALID_PARAMETER : ERROR_NOT_INITIALIZED;
+    }
+#if CONFIG_NUMA_REPLICATE_TABLES
+    const vlan_port_class_t *local = (*cls)->node_copy[sim_numa_current_node()];
+    if (local) {
+        *cls = local;
+    }
+#endif
+
+    return STATUS_SUCCESS;
+}
+
 /**
  * @brief Get the VLAN for an incoming packet
  *
+ * Runs on the forwarding path without the VLAN lock: the decision is a
+ * read of the port's RCU-published classification record.
+ *
  * @param port_id Port on which the packet was received
  * @param packet Packet to process
  * @param vlan_id Output parameter to store the assigned VLAN ID
  * @return status_t Status code
  */
 status_t vlan_get_packet_vlan(port_id_t port_id, const packet_buffer_t *packet, vlan_id_t *vlan_id) {
-    vlan_id_t vid;
-    bool has_vlan_tag;
+    const vlan_port_class_t *cls;
+    bool push_stag;
+    status_t status;
 
-    vlan_acquire_lock();
+    if (!packet || !vlan_id) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid packet or output parameter");
+        return ERROR_INVALID_PARAMETER;
+    }
 
-    if (!g_vlan_state.initialized) {
-        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
-        vlan_release_lock();
-        return ERROR_NOT_INITIALIZED;
+    // Lock-free: read the port's published classification record
+    status = vlan_port_class_get(port_id, &cls);
+    if (status != STATUS_SUCCESS) {
+        return status;
     }
 
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
-        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
-        vlan_release_lock();
-        return ERROR_INVALID_PARAMETER;
+    status = vlan_classify(port_id, cls, packet, vlan_id, &push_stag);
+
+    rcu_read_unlock();
+    return status;
+}
+
+/**
+ * @brief Count frames in a VLAN's counters
+ *
+ * @param vlan_id VLAN ID, valid
+ * @param packets_ctr VLAN_CTR_RX_PACKETS or VLAN_CTR_TX_PACKETS; the byte
+ *        counter follows it
+ * @param packets Number of frames
+ * @param bytes Bytes in those frames
+ */
+static inline void vlan_count(vlan_id_t vlan_id, uint32_t packets_ctr, uint64_t packets, uint64_t bytes) {
+    stats_shard_set_t *set = __atomic_load_n(&g_vlan_state.counters, __ATOMIC_ACQUIRE);
+    uint64_t *counters;
+
+    if (!set) {
+        return;
     }
+    counters = stats_shard_local(set) + (size_t)vlan_id * VLAN_CTR_WORDS + packets_ctr;
+    stats_shard_add(&counters[0], packets);
+    stats_shard_add(&counters[1], bytes);
+}
+
+/**
+ * @brief Classify an incoming packet and normalize its outer tag in place
+ *
+ * @param port_id Port on which the packet was received
+ * @param packet Packet to classify
+ * @param vlan_id Output VLAN (S-VLAN on QinQ ports)
+ * @return status_t Status code
+ */
+status_t vlan_process_ingress_inplace(port_id_t port_id, packet_buffer_t *packet, vlan_id_t *vlan_id) {
+    const vlan_port_class_t *cls;
+    bool push_stag;
+    status_t status;
 
     if (!packet || !vlan_id) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid packet or output parameter");
-        vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
     }
 
-    // Get VLAN tag information directly from packet metadata
-    has_vlan_tag = packet->metadata.is_tagged;
-    vid = has_vlan_tag ? packet->metadata.vlan : 0;
-
-    if (has_vlan_tag) {
-        // Check if the VLAN is valid
-        if (!is_vlan_id_valid(vid)) {
-            LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Packet has invalid VLAN ID %d", vid);
-            vlan_release_lock();
-            return ERROR_INVALID_PACKET;
-        }
+    status = vlan_port_class_get(port_id, &cls);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
 
-        // Check if the VLAN exists
-        if (!g_vlan_state.vlans[vid].active) {
-            LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Packet has nonexistent VLAN ID %d", vid);
-            vlan_release_lock();
-            return ERROR_INVALID_PACKET;
-        }
+    status = vlan_classify(port_id, cls, packet, vlan_id, &push_stag);
 
-        // Check if the port is a member of this VLAN
-        if (!test_bitmap_bit(g_vlan_state.vlans[vid].port_membership, port_id)) {
-            LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Port %d is not a member of VLAN %d", port_id, vid);
-            vlan_release_lock();
-            return ERROR_INVALID_PACKET;
-        }
+    rcu_read_unlock();
 
-        // For access ports, tagged packets are not allowed
-        if (g_vlan_state.port_configs[port_id].mode == PORT_VLAN_MODE_ACCESS) {
-            LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Access port %d received a tagged packet", port_id);
-            vlan_release_lock();
-            return ERROR_INVALID_PACKET;
-        }
+    if (status != STATUS_SUCCESS) {
+        packet_drop_count(packet, PACKET_DROP_VLAN_FILTER);
+        return status;
+    }
 
-        // For trunk ports, check if the VLAN is allowed
-        if (g_vlan_state.port_configs[port_id].mode == PORT_VLAN_MODE_TRUNK &&
-            !test_bitmap_bit(g_vlan_state.port_configs[port_id].allowed_vlans, vid)) {
-            LOG_ERROR(LOG_CATEGORY_L2, "VLAN: VLAN %d not allowed on trunk port %d", vid, port_id);
-            vlan_release_lock();
-            return ERROR_INVALID_PACKET;
-        }
+    vlan_count(*vlan_id, VLAN_CTR_RX_PACKETS, 1, packet_chain_length(packet));
 
-        // Assign the VLAN ID from the packet
-        *vlan_id = vid;
-    } else {
-        // No VLAN tag, use the default VLAN based on port mode
-        switch (g_vlan_state.port_configs[port_id].mode) {
-            case PORT_VLAN_MODE_ACCESS:
-                *vlan_id = g_vlan_state.port_configs[port_id].access_vlan;
-                break;
-            case PORT_VLAN_MODE_TRUNK:
-            case PORT_VLAN_MODE_HYBRID:
-                *vlan_id = g_vlan_state.port_configs[port_id].native_vlan;
-                break;
-            default:
-                LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Unknown port mode for port %d", port_id);
-                vlan_release_lock();
-                return ERROR_INTERNAL;
-        }
+    if (!push_stag) {
+        return STATUS_SUCCESS;
     }
 
-    vlan_release_lock();
-    return STATUS_SUCCESS;
+    // The S-tag inherits the customer priority
+    return packet_vlan_push(packet, ETHERTYPE_QINQ,
+                            (uint16_t)(((packet->metadata.priority & 0x7) << 13) | (*vlan_id & 0x0FFF)));
 }
 
 
@@ -1383,7 +1911,7 @@ status_t vlan_get_packet_vlan(port_id_t port_id, const packet_buffer_t *packet,
 //        return ERROR_NOT_INITIALIZED;
 //    }
 //    
-//    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+//    if (!vlan_port_valid(port_id)) {
 //        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
 //        vlan_release_lock();
 //        return ERROR_INVALID_PARAMETER;
@@ -1414,7 +1942,7 @@ status_t vlan_get_packet_vlan(port_id_t port_id, const packet_buffer_t *packet,
 //        }
 //        
 //        // Check if the port is a member of this VLAN
-//        if (!test_bitmap_bit(g_vlan_state.vlans[vid].port_membership, port_id)) {
+//        if (!bitmap_test(g_vlan_state.vlans[vid].port_membership, port_id)) {
 //            LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Port %d is not a member of VLAN %d", port_id, vid);
 //            vlan_release_lock();
 //            return ERROR_INVALID_PACKET;
@@ -1429,7 +1957,7 @@ status_t vlan_get_packet_vlan(port_id_t port_id, const packet_buffer_t *packet,
 //        
 //        // For trunk ports, check if the VLAN is allowed
 //        if (g_vlan_state.port_configs[port_id].mode == PORT_VLAN_MODE_TRUNK &&
-//            !test_bitmap_bit(g_vlan_state.port_configs[port_id].allowed_vlans, vid)) {
+//            !bitmap_test(g_vlan_state.port_configs[port_id].allowed_vlans, vid)) {
 //            LOG_ERROR(LOG_CATEGORY_L2, "VLAN: VLAN %d not allowed on trunk port %d", vid, port_id);
 //            vlan_release_lock();
 //            return ERROR_INVALID_PACKET;
@@ -1504,7 +2032,7 @@ status_t vlan_should_tag_packet(port_id_t port_id, vlan_id_t vlan_id, bool *shou
         return STATUS_NOT_FOUND;
     }
     
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
@@ -1517,7 +2045,7 @@ status_t vlan_should_tag_packet(port_id_t port_id, vlan_id_t vlan_id, bool *shou
     }
     
     // Check if port is a member of the VLAN
-    if (!test_bitmap_bit(g_vlan_state.vlans[vlan_id].port_membership, port_id)) {
+    if (!bitmap_test(g_vlan_state.vlans[vlan_id].port_membership, port_id)) {
         // Port is not a member of this VLAN, packet should be dropped
         *should_tag = false;
         vlan_release_lock();
@@ -1525,7 +2053,7 @@ status_t vlan_should_tag_packet(port_id_t port_id, vlan_id_t vlan_id, bool *shou
     }
     
     // Check if the port is configured as untagged for this VLAN
-    if (test_bitmap_bit(g_vlan_state.vlans[vlan_id].untagged_ports, port_id)) {
+    if (bitmap_test(g_vlan_state.vlans[vlan_id].untagged_ports, port_id)) {
         *should_tag = false;
     } else {
         *should_tag = true;
@@ -1693,6 +2221,51 @@ status_t vlan_get_active_vlans(vlan_id_t *vlan_list, uint32_t max_vlans, uint32_
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Get the next page of active VLANs
+ *
+ * The cursor holds the next VLAN ID to look at.
+ *
+ * @param cursor Cursor, moved past the VLANs returned
+ * @param vlan_list Output array to store VLAN IDs
+ * @param max_vlans Size of the array
+ * @param num_vlans Output parameter to store the actual number of VLANs
+ * @return status_t Status code
+ */
+status_t vlan_get_active_vlans_page(table_cursor_t *cursor, vlan_id_t *vlan_list, uint32_t max_vlans,
+                                    uint32_t *num_vlans) {
+    uint32_t count = 0;
+    uint32_t i;
+
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    if (!cursor || !vlan_list || !num_vlans || max_vlans == 0) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid parameters");
+        vlan_release_lock();
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    i = *cursor == TABLE_CURSOR_END ? VLAN_MAX_COUNT : table_cursor_bucket(*cursor);
+    for (; i < VLAN_MAX_COUNT && count < max_vlans; i++) {
+        if (g_vlan_state.vlans[i].active) {
+            vlan_list[count++] = i;
+        }
+    }
+
+    // A full page leaves the rest for the next call, even if no active VLAN is left
+    *cursor = i < VLAN_MAX_COUNT ? table_cursor_make(i, 0, 0) : TABLE_CURSOR_END;
+    *num_vlans = count;
+
+    vlan_release_lock();
+    return STATUS_SUCCESS;
+}
+
 /**
  * @brief Get the member ports of a VLAN
  *
@@ -1703,9 +2276,6 @@ status_t vlan_get_active_vlans(vlan_id_t *vlan_list, uint32_t max_vlans, uint32_
  * @return status_t Status code
  */
 status_t vlan_get_member_ports(vlan_id_t vlan_id, port_id_t *port_list, uint32_t max_ports, uint32_t *num_ports) {
-    uint32_t count = 0;
-    uint32_t i;
-
     vlan_acquire_lock();
 
     if (!g_vlan_state.initialized) {
@@ -1733,13 +2303,7 @@ status_t vlan_get_member_ports(vlan_id_t vlan_id, port_id_t *port_list, uint32_t
     }
 
     // Find all member ports
-    for (i = 0; i < g_vlan_state.num_ports && count < max_ports; i++) {
-        if (test_bitmap_bit(g_vlan_state.vlans[vlan_id].port_membership, i)) {
-            port_list[count++] = i;
-        }
-    }
-
-    *num_ports = count;
+    *num_ports = bitmap_collect(g_vlan_state.vlans[vlan_id].port_membership, VLAN_PORT_WORDS, port_list, max_ports);
 
     vlan_release_lock();
     return STATUS_SUCCESS;
@@ -1755,8 +2319,7 @@ status_t vlan_get_member_ports(vlan_id_t vlan_id, port_id_t *port_list, uint32_t
  * @return status_t Status code
  */
 status_t vlan_get_untagged_ports(vlan_id_t vlan_id, port_id_t *port_list, uint32_t max_ports, uint32_t *num_ports) {
-    uint32_t count = 0;
-    uint32_t i;
+    uint64_t ports[VLAN_PORT_WORDS];
 
     vlan_acquire_lock();
 
@@ -1785,14 +2348,9 @@ status_t vlan_get_untagged_ports(vlan_id_t vlan_id, port_id_t *port_list, uint32
     }
 
     // Find all untagged ports
-    for (i = 0; i < g_vlan_state.num_ports && count < max_ports; i++) {
-        if (test_bitmap_bit(g_vlan_state.vlans[vlan_id].port_membership, i) &&
-            test_bitmap_bit(g_vlan_state.vlans[vlan_id].untagged_ports, i)) {
-            port_list[count++] = i;
-        }
-    }
-
-    *num_ports = count;
+    bitmap_and(ports, g_vlan_state.vlans[vlan_id].port_membership,
+               g_vlan_state.vlans[vlan_id].untagged_ports, VLAN_PORT_WORDS);
+    *num_ports = bitmap_collect(ports, VLAN_PORT_WORDS, port_list, max_ports);
 
     vlan_release_lock();
     return STATUS_SUCCESS;
@@ -1808,8 +2366,7 @@ status_t vlan_get_untagged_ports(vlan_id_t vlan_id, port_id_t *port_list, uint32
  * @return status_t Status code
  */
 status_t vlan_get_tagged_ports(vlan_id_t vlan_id, port_id_t *port_list, uint32_t max_ports, uint32_t *num_ports) {
-    uint32_t count = 0;
-    uint32_t i;
+    uint64_t ports[VLAN_PORT_WORDS];
 
     vlan_acquire_lock();
 
@@ -1838,14 +2395,9 @@ status_t vlan_get_tagged_ports(vlan_id_t vlan_id, port_id_t *port_list, uint32_t
     }
 
     // Find all tagged ports (ports that are members but not untagged)
-    for (i = 0; i < g_vlan_state.num_ports && count < max_ports; i++) {
-        if (test_bitmap_bit(g_vlan_state.vlans[vlan_id].port_membership, i) &&
-            !test_bitmap_bit(g_vlan_state.vlans[vlan_id].untagged_ports, i)) {
-            port_list[count++] = i;
-        }
-    }
-
-    *num_ports = count;
+    bitmap_andnot(ports, g_vlan_state.vlans[vlan_id].port_membership,
+                  g_vlan_state.vlans[vlan_id].untagged_ports, VLAN_PORT_WORDS);
+    *num_ports = bitmap_collect(ports, VLAN_PORT_WORDS, port_list, max_ports);
 
     vlan_release_lock();
     return STATUS_SUCCESS;
@@ -1872,7 +2424,7 @@ status_t vlan_get_port_vlans(port_id_t port_id, vlan_id_t *vlan_list, uint32_t m
         return ERROR_NOT_INITIALIZED;
     }
 
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
@@ -1887,7 +2439,7 @@ status_t vlan_get_port_vlans(port_id_t port_id, vlan_id_t *vlan_list, uint32_t m
     // Find all VLANs this port is a member of
     for (i = 0; i < VLAN_MAX_COUNT && count < max_vlans; i++) {
         if (g_vlan_state.vlans[i].active &&
-            test_bitmap_bit(g_vlan_state.vlans[i].port_membership, port_id)) {
+            bitmap_test(g_vlan_state.vlans[i].port_membership, port_id)) {
             vlan_list[count++] = i;
         }
     }
@@ -1899,17 +2451,27 @@ status_t vlan_get_port_vlans(port_id_t port_id, vlan_id_t *vlan_list, uint32_t m
 }
 
 /**
- * @brief Process a packet for VLAN tagging/untagging on egress
+ * @brief Get the ports a frame received on a VLAN should be flooded to
  *
- * @param packet Packet to process
- * @param vlan_id VLAN ID associated with the packet
- * @param out_port Port on which the packet will be sent
- * @param out_packet Output packet after VLAN processing
+ * Returns the VLAN's precomputed flood mask (members that are STP
+ * forwarding and link-up) with the ingress port removed.
+ *
+ * @param vlan_id VLAN ID
+ * @param in_port Ingress port, or PORT_ID_INVALID for locally originated frames
+ * @param ports Output bitmap of egress ports
  * @return status_t Status code
  */
-status_t vlan_process_egress(const packet_buffer_t *packet, vlan_id_t vlan_id, port_id_t out_port, packet_buffer_t *out_packet) {
-    bool tag_required;
-    status_t ret;
+status_t vlan_get_flood_ports(vlan_id_t vlan_id, port_id_t in_port, vlan_port_bitmap_t *ports) {
+
+    if (!ports) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid parameters");
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (!is_vlan_id_valid(vlan_id)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid VLAN ID %d", vlan_id);
+        return ERROR_INVALID_PARAMETER;
+    }
 
     vlan_acquire_lock();
 
@@ -1919,7 +2481,112 @@ status_t vlan_process_egress(const packet_buffer_t *packet, vlan_id_t vlan_id, p
         return ERROR_NOT_INITIALIZED;
     }
 
-    if (!packet || !out_packet) {
+    if (!g_vlan_state.vlans[vlan_id].active) {
+        vlan_release_lock();
+        return STATUS_NOT_FOUND;
+    }
+
+    bitmap_copy(ports->w, g_vlan_state.vlans[vlan_id].flood_ports, VLAN_PORT_WORDS);
+
+    vlan_release_lock();
+
+    if (in_port < VLAN_PORT_WORDS * 64) {
+        bitmap_clear(ports->w, in_port);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Update a port bit in one of the egress state bitmaps
+ *
+ * @param bitmap Bitmap to update (stp_forwarding or link_up)
+ * @param port_id Port ID
+ * @param set New value of the bit
+ * @return status_t Status code
+ */
+static status_t vlan_update_port_state(uint64_t *bitmap, port_id_t port_id, bool set) {
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    if (!vlan_port_valid(port_id)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
+        vlan_release_lock();
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (bitmap_assign(bitmap, port_id, set)) {
+        vlan_refresh_all_flood_ports();
+    }
+
+    vlan_release_lock();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Set whether STP allows a port to forward frames
+ *
+ * @param port_id Port ID
+ * @param forwarding True if the port is in the forwarding state
+ * @return status_t Status code
+ */
+status_t vlan_set_port_forwarding(port_id_t port_id, bool forwarding) {
+    return vlan_update_port_state(g_vlan_state.stp_forwarding, port_id, forwarding);
+}
+
+/**
+ * @brief Set the link state of a port for flood mask computation
+ *
+ * @param port_id Port ID
+ * @param link_up True if the port link is up
+ * @return status_t Status code
+ */
+status_t vlan_set_port_link(port_id_t port_id, bool link_up) {
+    return vlan_update_port_state(g_vlan_state.link_up, port_id, link_up);
+}
+
+/**
+ * @brief VID a VLAN is transmitted with on a port
+ *
+ * Must be called with the VLAN lock held.
+ *
+ * @param port_id Egress port
+ * @param vlan_id Internal VLAN ID
+ * @return vlan_id_t Translated VID, or vlan_id if the port has no entry
+ */
+static vlan_id_t vlan_egress_vid(port_id_t port_id, vlan_id_t vlan_id) {
+    const vlan_id_t *map = g_vlan_state.port_configs[port_id].egress_xlate;
+
+    return (map && map[vlan_id]) ? map[vlan_id] : vlan_id;
+}
+
+/**
+ * @brief Process a packet for VLAN tagging/untagging on egress
+ *
+ * @param packet Packet to process
+ * @param vlan_id VLAN ID associated with the packet
+ * @param out_port Port on which the packet will be sent
+ * @param out_packet Output packet after VLAN processing
+ * @return status_t Status code
+ */
+status_t vlan_process_egress(const packet_buffer_t *packet, vlan_id_t vlan_id, port_id_t out_port, packet_buffer_t *out_packet) {
+    bool tag_required;
+    vlan_id_t wire_vid;
+    status_t ret;
+
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    if (!packet || !out_packet) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid packet parameters");
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
@@ -1937,28 +2604,29 @@ status_t vlan_process_egress(const packet_buffer_t *packet, vlan_id_t vlan_id, p
         return STATUS_NOT_FOUND;
     }
 
-    if (!port_is_valid(out_port) || out_port >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(out_port)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", out_port);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
     }
 
     // Check if port is a member of the VLAN
-    if (!test_bitmap_bit(g_vlan_state.vlans[vlan_id].port_membership, out_port)) {
+    if (!bitmap_test(g_vlan_state.vlans[vlan_id].port_membership, out_port)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Port %d is not a member of VLAN %d", out_port, vlan_id);
         vlan_release_lock();
         return STATUS_INVALID_PORT;
     }
 
     // Determine if tagging is required
-    tag_required = !test_bitmap_bit(g_vlan_state.vlans[vlan_id].untagged_ports, out_port);
+    tag_required = !bitmap_test(g_vlan_state.vlans[vlan_id].untagged_ports, out_port);
+    wire_vid = vlan_egress_vid(out_port, vlan_id);
 
     if (tag_required) {
         // Check if packet already has a VLAN tag
         vlan_id_t existing_vid;
         bool has_tag = packet_has_vlan_tag(packet, &existing_vid);
 
-        if (has_tag && existing_vid == vlan_id) {
+        if (has_tag && existing_vid == wire_vid) {
             // Packet already has the correct VLAN tag, just copy it
             if (packet_copy(packet, out_packet) != STATUS_SUCCESS) {
                 LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Failed to copy packet");
@@ -1967,14 +2635,14 @@ status_t vlan_process_egress(const packet_buffer_t *packet, vlan_id_t vlan_id, p
             }
         } else if (has_tag) {
             // Packet has a different VLAN tag, modify it
-            if (packet_set_vlan_tag(packet, vlan_id, out_packet) != STATUS_SUCCESS) {
+            if (packet_set_vlan_tag(packet, wire_vid, out_packet) != STATUS_SUCCESS) {
                 LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Failed to modify VLAN tag");
                 vlan_release_lock();
                 return ERROR_INTERNAL;
             }
         } else {
             // Packet has no VLAN tag, add one
-            if (packet_add_vlan_tag(packet, vlan_id, out_packet) != STATUS_SUCCESS) {
+            if (packet_add_vlan_tag(packet, wire_vid, out_packet) != STATUS_SUCCESS) {
                 LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Failed to add VLAN tag");
                 vlan_release_lock();
                 return ERROR_INTERNAL;
@@ -2003,9 +2671,265 @@ status_t vlan_process_egress(const packet_buffer_t *packet, vlan_id_t vlan_id, p
     }
 
     vlan_release_lock();
+
+    vlan_count(vlan_id, VLAN_CTR_TX_PACKETS, 1, packet_chain_length(out_packet));
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Bring a packet's outer tag in line with an egress requirement
+ *
+ * @param packet Packet to modify
+ * @param vlan_id VLAN ID of the packet
+ * @param tag_required Whether the frame must leave tagged
+ * @param stag Whether a required tag must be an S-tag (provider network egress)
+ * @return status_t Status code
+ */
+static status_t vlan_retag_inplace(packet_buffer_t *packet, vlan_id_t vlan_id, bool tag_required, bool stag) {
+    vlan_id_t existing_vid;
+    bool has_tag = packet_has_vlan_tag(packet, &existing_vid);
+
+    if (tag_required) {
+        if (!has_tag) {
+            uint16_t tci = (uint16_t)(((packet->metadata.priority & 0x7) << 13) | (vlan_id & 0x0FFF));
+            return packet_vlan_push(packet, stag ? ETHERTYPE_QINQ : ETHERTYPE_VLAN, tci);
+        }
+        if (stag) {
+            status_t status = packet_vlan_set_tpid(packet, ETHERTYPE_QINQ);
+            if (status != STATUS_SUCCESS) {
+                return status;
+            }
+        }
+        if (existing_vid != vlan_id) {
+            return packet_vlan_set_vid(packet, vlan_id);
+        }
+    } else if (has_tag) {
+        return packet_vlan_pop(packet, NULL);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Process a packet for VLAN tagging/untagging on egress in place
+ *
+ * @param packet Packet to modify
+ * @param vlan_id VLAN ID associated with the packet
+ * @param out_port Port on which the packet will be sent
+ * @return status_t Status code
+ */
+status_t vlan_process_egress_inplace(packet_buffer_t *packet, vlan_id_t vlan_id, port_id_t out_port) {
+    bool tag_required;
+    vlan_id_t wire_vid;
+    bool stag;
+    status_t status;
+
+    if (!packet) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid packet parameters");
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (!is_vlan_id_valid(vlan_id)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid VLAN ID %d", vlan_id);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    if (!g_vlan_state.vlans[vlan_id].active) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: VLAN %d does not exist", vlan_id);
+        vlan_release_lock();
+        return STATUS_NOT_FOUND;
+    }
+
+    if (out_port >= g_vlan_state.num_ports && !lag_port_is_lag(out_port)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", out_port);
+        vlan_release_lock();
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (!bitmap_test(g_vlan_state.vlans[vlan_id].port_membership, out_port)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Port %d is not a member of VLAN %d", out_port, vlan_id);
+        vlan_release_lock();
+        return STATUS_INVALID_PORT;
+    }
+
+    tag_required = !bitmap_test(g_vlan_state.vlans[vlan_id].untagged_ports, out_port);
+    stag = bitmap_test(g_vlan_state.qinq_provider, out_port);
+    wire_vid = vlan_egress_vid(out_port, vlan_id);
+
+    vlan_release_lock();
+
+    // Packet data is modified outside the lock
+    status = vlan_retag_inplace(packet, wire_vid, tag_required, stag);
+    if (status == STATUS_SUCCESS) {
+        vlan_count(vlan_id, VLAN_CTR_TX_PACKETS, 1, packet_chain_length(packet));
+    }
+    return status;
+}
+
+/**
+ * @brief Count the copies of a flood that leave through the shared buffers
+ *
+ * Translated ports are counted by vlan_process_egress_inplace().
+ *
+ * @param vlan_id VLAN ID of the frame
+ * @param flood Prepared flood
+ */
+static void vlan_count_flood(vlan_id_t vlan_id, const vlan_flood_t *flood) {
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+
+    if (flood->tagged) {
+        uint32_t n = bitmap_count(flood->tagged_ports.w, VLAN_PORT_WORDS);
+        packets += n;
+        bytes += (uint64_t)n * packet_chain_length(flood->tagged);
+    }
+    if (flood->untagged) {
+        uint32_t n = bitmap_count(flood->untagged_ports.w, VLAN_PORT_WORDS);
+        packets += n;
+        bytes += (uint64_t)n * packet_chain_length(flood->untagged);
+    }
+    if (packets) {
+        vlan_count(vlan_id, VLAN_CTR_TX_PACKETS, packets, bytes);
+    }
+}
+
+/**
+ * @brief Prepare the egress buffers for flooding a frame in a VLAN
+ *
+ * @param packet Frame to flood
+ * @param vlan_id VLAN ID of the frame
+ * @param in_port Ingress port, or PORT_ID_INVALID
+ * @param flood Output egress groups and buffers
+ * @return status_t Status code
+ */
+status_t vlan_flood_prepare(packet_buffer_t *packet, vlan_id_t vlan_id, port_id_t in_port, vlan_flood_t *flood) {
+    const vlan_internal_entry_t *vlan;
+    bool original_tagged;
+    bool stag = false;
+    bool tagged_empty;
+    bool untagged_empty;
+    status_t status;
+    uint64_t tagged[VLAN_PORT_WORDS];
+
+    if (!packet || !flood) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid packet parameters");
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    memset(flood, 0, sizeof(vlan_flood_t));
+
+    if (!is_vlan_id_valid(vlan_id)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid VLAN ID %d", vlan_id);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    vlan = &g_vlan_state.vlans[vlan_id];
+    if (!vlan->active) {
+        vlan_release_lock();
+        return STATUS_NOT_FOUND;
+    }
+
+    // Split the flood mask by tagging requirement; the tagged buffer
+    // carries an S-tag when any tagged member is a provider network port.
+    // Ports that translate the VID on egress cannot share it.
+    bitmap_andnot(tagged, vlan->flood_ports, vlan->untagged_ports, VLAN_PORT_WORDS);
+    bitmap_andnot(flood->tagged_ports.w, tagged, vlan->egress_xlate_ports, VLAN_PORT_WORDS);
+    bitmap_and(flood->translated_ports.w, tagged, vlan->egress_xlate_ports, VLAN_PORT_WORDS);
+    bitmap_and(flood->untagged_ports.w, vlan->flood_ports, vlan->untagged_ports, VLAN_PORT_WORDS);
+    stag = bitmap_intersects(flood->tagged_ports.w, g_vlan_state.qinq_provider, VLAN_PORT_WORDS);
+
+    vlan_release_lock();
+
+    if (in_port < VLAN_PORT_WORDS * 64) {
+        bitmap_clear(flood->tagged_ports.w, in_port);
+        bitmap_clear(flood->translated_ports.w, in_port);
+        bitmap_clear(flood->untagged_ports.w, in_port);
+    }
+
+    tagged_empty = bitmap_empty(flood->tagged_ports.w, VLAN_PORT_WORDS);
+    untagged_empty = bitmap_empty(flood->untagged_ports.w, VLAN_PORT_WORDS);
+    if (tagged_empty && untagged_empty && bitmap_empty(flood->translated_ports.w, VLAN_PORT_WORDS)) {
+        return STATUS_SUCCESS;
+    }
+
+    // Police before any replication work is done
+    if (!storm_control_admit(in_port, vlan_id, packet)) {
+        memset(flood, 0, sizeof(vlan_flood_t));
+        return STATUS_RESOURCE_EXCEEDED;
+    }
+
+    if (tagged_empty && untagged_empty) {
+        return STATUS_SUCCESS;
+    }
+
+    // The original serves the group it needs the least work for
+    original_tagged = untagged_empty || (!tagged_empty && packet_has_vlan_tag(packet, NULL));
+
+    status = vlan_retag_inplace(packet, vlan_id, original_tagged, stag);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    if (original_tagged) {
+        flood->tagged = packet;
+    } else {
+        flood->untagged = packet;
+    }
+
+    if (!tagged_empty && !untagged_empty) {
+        flood->clone = packet_buffer_clone_shared(packet);
+        if (!flood->clone) {
+            LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Failed to clone packet for flooding");
+            memset(flood, 0, sizeof(vlan_flood_t));
+            return STATUS_NO_MEMORY;
+        }
+
+        status = vlan_retag_inplace(flood->clone, vlan_id, !original_tagged, stag);
+        if (status != STATUS_SUCCESS) {
+            packet_buffer_free(flood->clone);
+            memset(flood, 0, sizeof(vlan_flood_t));
+            return status;
+        }
+
+        if (original_tagged) {
+            flood->untagged = flood->clone;
+        } else {
+            flood->tagged = flood->clone;
+        }
+    }
+
+    vlan_count_flood(vlan_id, flood);
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Free the buffer allocated by vlan_flood_prepare()
+ *
+ * @param flood Flood state
+ */
+void vlan_flood_release(vlan_flood_t *flood) {
+    if (flood && flood->clone) {
+        packet_buffer_free(flood->clone);
+        flood->clone = NULL;
+    }
+}
+
 /**
  * @brief Reset all VLAN configurations to default
  *
@@ -2013,7 +2937,6 @@ status_t vlan_process_egress(const packet_buffer_t *packet, vlan_id_t vlan_id, p
  */
 status_t vlan_reset_config(void) {
     uint32_t i;
-    uint32_t bitmap_size;
 
     vlan_acquire_lock();
 
@@ -2023,21 +2946,12 @@ status_t vlan_reset_config(void) {
         return ERROR_NOT_INITIALIZED;
     }
 
-    // Calculate bitmap size based on number of ports
-    bitmap_size = (g_vlan_state.num_ports + 7) / 8;
-
     // Reset all VLANs except the default one
     for (i = 1; i < g_vlan_state.max_vlan_id; i++) {
         if (i == VLAN_DEFAULT_ID) {
-            // For default VLAN, just reset port memberships
-            memset(g_vlan_state.vlans[i].port_membership, 0, bitmap_size);
-            memset(g_vlan_state.vlans[i].untagged_ports, 0, bitmap_size);
-            
-            // Add all ports to default VLAN as untagged
-            for (uint32_t port = 0; port < g_vlan_state.num_ports; port++) {
-                set_bitmap_bit(g_vlan_state.vlans[i].port_membership, port);
-                set_bitmap_bit(g_vlan_state.vlans[i].untagged_ports, port);
-            }
+            // For default VLAN, add all ports back as untagged
+            bitmap_fill(g_vlan_state.vlans[i].port_membership, VLAN_PORT_WORDS, g_vlan_state.num_ports);
+            bitmap_fill(g_vlan_state.vlans[i].untagged_ports, VLAN_PORT_WORDS, g_vlan_state.num_ports);
             
             // Make sure default VLAN is active and named properly
             g_vlan_state.vlans[i].active = true;
@@ -2046,22 +2960,37 @@ status_t vlan_reset_config(void) {
         } else if (g_vlan_state.vlans[i].active) {
             // Deactivate non-default VLANs
             g_vlan_state.vlans[i].active = false;
-            memset(g_vlan_state.vlans[i].port_membership, 0, bitmap_size);
-            memset(g_vlan_state.vlans[i].untagged_ports, 0, bitmap_size);
+            memset(g_vlan_state.vlans[i].port_membership, 0, sizeof(g_vlan_state.vlans[i].port_membership));
+            memset(g_vlan_state.vlans[i].untagged_ports, 0, sizeof(g_vlan_state.vlans[i].untagged_ports));
             g_vlan_state.vlans[i].name[0] = '\0';
         }
+        memset(g_vlan_state.vlans[i].egress_xlate_ports, 0, sizeof(g_vlan_state.vlans[i].egress_xlate_ports));
     }
 
+    vlan_refresh_all_flood_ports();
+
     // Reset all port configurations to access mode with default VLAN
-    for (i = 0; i < g_vlan_state.num_ports; i++) {
+    for (i = 0; i < VLAN_PORT_END; i = vlan_port_next(i)) {
         g_vlan_state.port_configs[i].mode = PORT_VLAN_MODE_ACCESS;
         g_vlan_state.port_configs[i].access_vlan = VLAN_DEFAULT_ID;
         g_vlan_state.port_configs[i].native_vlan = VLAN_DEFAULT_ID;
         
         // Reset allowed VLANs bitmap - only default VLAN is allowed
-        memset(g_vlan_state.port_configs[i].allowed_vlans, 0, bitmap_size);
-        set_bitmap_bit(g_vlan_state.port_configs[i].allowed_vlans, VLAN_DEFAULT_ID);
-    }
+        memset(g_vlan_state.port_configs[i].allowed_vlans, 0, sizeof(g_vlan_state.port_configs[i].allowed_vlans));
+        bitmap_set(g_vlan_state.port_configs[i].allowed_vlans, VLAN_DEFAULT_ID);
+        g_vlan_state.port_configs[i].accept_untagged = true;
+        g_vlan_state.port_configs[i].accept_tagged = true;
+        g_vlan_state.port_configs[i].ingress_filter = true;
+        g_vlan_state.port_configs[i].qinq_mode = VLAN_QINQ_NONE;
+        mem_free(MEM_TAG_VLAN, g_vlan_state.port_configs[i].s_vlan_map);
+        g_vlan_state.port_configs[i].s_vlan_map = NULL;
+        mem_free(MEM_TAG_VLAN, g_vlan_state.port_configs[i].ingress_xlate);
+        g_vlan_state.port_configs[i].ingress_xlate = NULL;
+        mem_free(MEM_TAG_VLAN, g_vlan_state.port_configs[i].egress_xlate);
+        g_vlan_state.port_configs[i].egress_xlate = NULL;
+    }
+    memset(g_vlan_state.qinq_provider, 0, sizeof(g_vlan_state.qinq_provider));
+    vlan_publish_all_port_classes();
 
     LOG_INFO(LOG_CATEGORY_L2, "VLAN: Reset all configurations to default");
     
@@ -2124,9 +3053,9 @@ status_t vlan_dump_config(void) {
             
             // Show member ports for this VLAN
             LOG_DEBUG(LOG_CATEGORY_L2, "  Member ports: ");
-            for (j = 0; j < g_vlan_state.num_ports; j++) {
-                if (test_bitmap_bit(g_vlan_state.vlans[i].port_membership, j)) {
-                    bool is_tagged = !test_bitmap_bit(g_vlan_state.vlans[i].untagged_ports, j);
+            for (j = 0; j < VLAN_PORT_END; j = vlan_port_next(j)) {
+                if (bitmap_test(g_vlan_state.vlans[i].port_membership, j)) {
+                    bool is_tagged = !bitmap_test(g_vlan_state.vlans[i].untagged_ports, j);
                     LOG_DEBUG(LOG_CATEGORY_L2, "    Port %d: %s", j, is_tagged ? "tagged" : "untagged");
                 }
             }
@@ -2135,7 +3064,7 @@ status_t vlan_dump_config(void) {
     
     // Dump port configurations
     LOG_DEBUG(LOG_CATEGORY_L2, "VLAN: Port configurations:");
-    for (i = 0; i < g_vlan_state.num_ports; i++) {
+    for (i = 0; i < VLAN_PORT_END; i = vlan_port_next(i)) {
         port_vlan_config_t *config = &g_vlan_state.port_configs[i];
         LOG_DEBUG(LOG_CATEGORY_L2, "  Port %d: Mode %s", i, vlan_mode_to_string(config->mode));
         
@@ -2145,7 +3074,7 @@ status_t vlan_dump_config(void) {
             LOG_DEBUG(LOG_CATEGORY_L2, "    Native VLAN: %d", config->native_vlan);
             LOG_DEBUG(LOG_CATEGORY_L2, "    Allowed VLANs: ");
             for (j = 1; j < g_vlan_state.max_vlan_id; j++) {
-                if (test_bitmap_bit(config->allowed_vlans, j)) {
+                if (bitmap_test(config->allowed_vlans, j)) {
                     LOG_DEBUG(LOG_CATEGORY_L2, "      %d", j);
                 }
             }
@@ -2158,6 +3087,55 @@ status_t vlan_dump_config(void) {
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Get the traffic counters of a VLAN
+ *
+ * @param vlan_id VLAN ID
+ * @param counters Output counters since the last clear
+ * @return status_t Status code
+ */
+status_t vlan_get_counters(vlan_id_t vlan_id, vlan_counters_t *counters) {
+    uint64_t words[VLAN_CTR_WORDS];
+
+    if (!counters || !is_vlan_id_valid(vlan_id)) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    if (!g_vlan_state.initialized) {
+        return ERROR_NOT_INITIALIZED;
+    }
+    if (!g_vlan_state.counters) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    stats_shard_fold(g_vlan_state.counters, (size_t)vlan_id * VLAN_CTR_WORDS, VLAN_CTR_WORDS, words);
+    counters->rx_packets = words[VLAN_CTR_RX_PACKETS];
+    counters->rx_bytes = words[VLAN_CTR_RX_BYTES];
+    counters->tx_packets = words[VLAN_CTR_TX_PACKETS];
+    counters->tx_bytes = words[VLAN_CTR_TX_BYTES];
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Clear the traffic counters of a VLAN
+ *
+ * @param vlan_id VLAN ID
+ * @return status_t Status code
+ */
+status_t vlan_clear_counters(vlan_id_t vlan_id) {
+    if (!is_vlan_id_valid(vlan_id)) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    if (!g_vlan_state.initialized) {
+        return ERROR_NOT_INITIALIZED;
+    }
+    if (!g_vlan_state.counters) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    stats_shard_clear(g_vlan_state.counters, (size_t)vlan_id * VLAN_CTR_WORDS, VLAN_CTR_WORDS);
+    return STATUS_SUCCESS;
+}
+
 /**
  * @brief Get statistics for a VLAN
  *
@@ -2168,7 +3146,6 @@ status_t vlan_dump_config(void) {
  * @return status_t Status code
  */
 status_t vlan_get_stats(vlan_id_t vlan_id, uint32_t *member_count, uint32_t *tagged_count, uint32_t *untagged_count) {
-    uint32_t i;
     uint32_t members = 0;
     uint32_t tagged = 0;
     uint32_t untagged = 0;
@@ -2200,17 +3177,10 @@ status_t vlan_get_stats(vlan_id_t vlan_id, uint32_t *member_count, uint32_t *tag
     }
     
     // Count member ports
-    for (i = 0; i < g_vlan_state.num_ports; i++) {
-        if (test_bitmap_bit(g_vlan_state.vlans[vlan_id].port_membership, i)) {
-            members++;
-            
-            if (test_bitmap_bit(g_vlan_state.vlans[vlan_id].untagged_ports, i)) {
-                untagged++;
-            } else {
-                tagged++;
-            }
-        }
-    }
+    members = bitmap_count(g_vlan_state.vlans[vlan_id].port_membership, VLAN_PORT_WORDS);
+    untagged = bitmap_count_and(g_vlan_state.vlans[vlan_id].port_membership,
+                                g_vlan_state.vlans[vlan_id].untagged_ports, VLAN_PORT_WORDS);
+    tagged = members - untagged;
     
     if (member_count) {
         *member_count = members;
@@ -2244,14 +3214,14 @@ status_t vlan_set_accept_untagged(port_id_t port_id, bool accept) {
         return ERROR_NOT_INITIALIZED;
     }
     
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
     }
     
-    // In a real implementation, this would set a flag in the port configuration
-    // For now, we'll just log the setting
+    g_vlan_state.port_configs[port_id].accept_untagged = accept;
+    vlan_publish_port_class(port_id);
     LOG_INFO(LOG_CATEGORY_L2, "VLAN: Port %d set to %s untagged packets", port_id, accept ? "accept" : "reject");
     
     vlan_release_lock();
@@ -2274,14 +3244,14 @@ status_t vlan_set_accept_tagged(port_id_t port_id, bool accept) {
         return ERROR_NOT_INITIALIZED;
     }
     
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
     }
     
-    // In a real implementation, this would set a flag in the port configuration
-    // For now, we'll just log the setting
+    g_vlan_state.port_configs[port_id].accept_tagged = accept;
+    vlan_publish_port_class(port_id);
     LOG_INFO(LOG_CATEGORY_L2, "VLAN: Port %d set to %s tagged packets", port_id, accept ? "accept" : "reject");
     
     vlan_release_lock();
@@ -2304,17 +3274,634 @@ status_t vlan_set_filtering(port_id_t port_id, bool enable) {
         return ERROR_NOT_INITIALIZED;
     }
     
-    if (!port_is_valid(port_id) || port_id >= g_vlan_state.num_ports) {
+    if (!vlan_port_valid(port_id)) {
         LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
         vlan_release_lock();
         return ERROR_INVALID_PARAMETER;
     }
     
-    // In a real implementation, this would set a flag in the port configuration
-    // For now, we'll just log the setting
+    g_vlan_state.port_configs[port_id].ingress_filter = enable;
+    vlan_publish_port_class(port_id);
     LOG_INFO(LOG_CATEGORY_L2, "VLAN: Port %d VLAN filtering %s", port_id, enable ? "enabled" : "disabled");
     
     vlan_release_lock();
     return STATUS_SUCCESS;
 }
 
+_Static_assert(sizeof(((port_vlan_config_t *)0)->allowed_vlans) == VLAN_ID_WORDS * sizeof(uint64_t),
+               "allowed_vlans must match the public VLAN ID bitmap");
+
+/**
+ * @brief Check a VLAN ID range passed to a bulk operation
+ *
+ * @param first_vlan First VLAN ID of the range
+ * @param last_vlan Last VLAN ID of the range (inclusive)
+ * @return bool True if both ends are valid and in order
+ */
+static bool is_vlan_range_valid(vlan_id_t first_vlan, vlan_id_t last_vlan) {
+    return is_vlan_id_valid(first_vlan) && is_vlan_id_valid(last_vlan) && first_vlan <= last_vlan;
+}
+
+/**
+ * @brief Create every VLAN in [first_vlan, last_vlan] in one operation
+ *
+ * @param first_vlan First VLAN ID of the range
+ * @param last_vlan Last VLAN ID of the range (inclusive)
+ * @return status_t Status code
+ */
+status_t vlan_create_range(vlan_id_t first_vlan, vlan_id_t last_vlan) {
+    uint32_t vid;
+
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    if (!is_vlan_range_valid(first_vlan, last_vlan)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid VLAN range %d-%d", first_vlan, last_vlan);
+        vlan_release_lock();
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    for (vid = first_vlan; vid <= last_vlan; vid++) {
+        if (g_vlan_state.vlans[vid].active) {
+            LOG_WARNING(LOG_CATEGORY_L2, "VLAN: VLAN %d already exists, range %d-%d not created",
+                        vid, first_vlan, last_vlan);
+            vlan_release_lock();
+            return STATUS_ALREADY_EXISTS;
+        }
+    }
+
+    for (vid = first_vlan; vid <= last_vlan; vid++) {
+        vlan_internal_entry_t *vlan = &g_vlan_state.vlans[vid];
+
+        vlan->vlan_id = vid;
+        vlan->active = true;
+        memset(vlan->port_membership, 0, sizeof(vlan->port_membership));
+        memset(vlan->untagged_ports, 0, sizeof(vlan->untagged_ports));
+        vlan_refresh_flood_ports(vlan);
+        snprintf(vlan->name, VLAN_NAME_MAX_LEN, "VLAN%d", vid);
+    }
+    vlan_publish_unfiltered_port_classes();
+
+    LOG_INFO(LOG_CATEGORY_L2, "VLAN: Created VLANs %d-%d", first_vlan, last_vlan);
+
+    vlan_release_lock();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Add a set of ports to every VLAN in [first_vlan, last_vlan]
+ *
+ * @param first_vlan First VLAN ID of the range
+ * @param last_vlan Last VLAN ID of the range (inclusive)
+ * @param ports Ports to add
+ * @param member_type Type of VLAN membership (tagged or untagged)
+ * @return status_t Status code
+ */
+status_t vlan_add_ports_bitmap(vlan_id_t first_vlan, vlan_id_t last_vlan,
+                               const vlan_port_bitmap_t *ports, vlan_member_type_t member_type) {
+    port_id_t port_list[CONFIG_MAX_PORTS];
+    uint64_t valid[VLAN_PORT_WORDS];
+    uint32_t num_ports;
+    uint32_t vid;
+    uint32_t i;
+
+    if (!ports || (member_type != VLAN_MEMBER_TAGGED && member_type != VLAN_MEMBER_UNTAGGED)) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    if (!is_vlan_range_valid(first_vlan, last_vlan)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid VLAN range %d-%d", first_vlan, last_vlan);
+        vlan_release_lock();
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    // Validate everything before touching any state
+    bitmap_fill(valid, VLAN_PORT_WORDS, g_vlan_state.num_ports);
+    for (i = CONFIG_LAG_PORT_BASE; i < VLAN_PORT_END; i++) {
+        bitmap_set(valid, i);
+    }
+    bitmap_andnot(valid, ports->w, valid, VLAN_PORT_WORDS);
+    if (!bitmap_empty(valid, VLAN_PORT_WORDS)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Port bitmap has ports beyond port %d", g_vlan_state.num_ports - 1);
+        vlan_release_lock();
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    num_ports = bitmap_collect(ports->w, VLAN_PORT_WORDS, port_list, CONFIG_MAX_PORTS);
+    for (i = 0; i < num_ports; i++) {
+        if (!vlan_port_valid(port_list[i])) {
+            LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_list[i]);
+            vlan_release_lock();
+            return ERROR_INVALID_PARAMETER;
+        }
+    }
+
+    for (vid = first_vlan; vid <= last_vlan; vid++) {
+        if (!g_vlan_state.vlans[vid].active) {
+            LOG_ERROR(LOG_CATEGORY_L2, "VLAN: VLAN %d does not exist", vid);
+            vlan_release_lock();
+            return STATUS_NOT_FOUND;
+        }
+    }
+
+    for (vid = first_vlan; vid <= last_vlan; vid++) {
+        vlan_internal_entry_t *vlan = &g_vlan_state.vlans[vid];
+
+        bitmap_or(vlan->port_membership, vlan->port_membership, ports->w, VLAN_PORT_WORDS);
+        if (member_type == VLAN_MEMBER_UNTAGGED) {
+            bitmap_or(vlan->untagged_ports, vlan->untagged_ports, ports->w, VLAN_PORT_WORDS);
+        } else {
+            bitmap_andnot(vlan->untagged_ports, vlan->untagged_ports, ports->w, VLAN_PORT_WORDS);
+        }
+        vlan_refresh_flood_ports(vlan);
+    }
+
+    // Each port's allowed list and classification is updated once for the whole range
+    for (i = 0; i < num_ports; i++) {
+        uint64_t *allowed = g_vlan_state.port_configs[port_list[i]].allowed_vlans;
+
+        for (vid = first_vlan; vid <= last_vlan; vid++) {
+            bitmap_set(allowed, vid);
+        }
+        vlan_publish_port_class(port_list[i]);
+    }
+
+    LOG_INFO(LOG_CATEGORY_L2, "VLAN: Added %d ports to VLANs %d-%d as %s", num_ports, first_vlan, last_vlan,
+             member_type == VLAN_MEMBER_TAGGED ? "tagged" : "untagged");
+
+    vlan_release_lock();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Add or remove a list of VLAN memberships under one lock
+ *
+ * Each VLAN's flood set and each port's classification is rebuilt once
+ * for the whole list, after the last membership is applied.
+ *
+ * @param members Memberships
+ * @param count Number of memberships
+ * @param add Add the memberships if true, remove them otherwise
+ * @param stop_on_error Stop at the first membership that fails
+ * @param statuses Status of each membership, may be NULL
+ * @return status_t STATUS_SUCCESS, or the error of the last membership that failed
+ */
+static status_t vlan_update_members(const vlan_member_t *members, uint32_t count, bool add,
+                                    bool stop_on_error, status_t *statuses) {
+    uint64_t vlans_touched[VLAN_ID_WORDS];
+    vlan_port_bitmap_t ports_touched;
+    port_id_t port_list[CONFIG_MAX_PORTS];
+    status_t result = STATUS_SUCCESS;
+    uint32_t num_ports;
+    uint32_t i = 0;
+    uint32_t vid;
+
+    if (!members && count > 0) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    memset(vlans_touched, 0, sizeof(vlans_touched));
+    memset(&ports_touched, 0, sizeof(ports_touched));
+
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    while (i < count) {
+        const vlan_member_t *member = &members[i];
+        status_t status = add ? vlan_add_port_locked(member->vlan_id, member->port_id, member->member_type)
+                              : vlan_remove_port_locked(member->vlan_id, member->port_id);
+
+        if (statuses) {
+            statuses[i] = status;
+        }
+        i++;
+        if (status == STATUS_SUCCESS) {
+            bitmap_set(vlans_touched, member->vlan_id);
+            bitmap_set(ports_touched.w, member->port_id);
+        } else {
+            result = status;
+            if (stop_on_error) {
+                break;
+            }
+        }
+    }
+
+    for (vid = VLAN_ID_MIN; vid <= VLAN_ID_MAX; vid++) {
+        if (bitmap_test(vlans_touched, vid)) {
+            vlan_refresh_flood_ports(&g_vlan_state.vlans[vid]);
+        }
+    }
+    num_ports = bitmap_collect(ports_touched.w, VLAN_PORT_WORDS, port_list, CONFIG_MAX_PORTS);
+    for (uint32_t p = 0; p < num_ports; p++) {
+        vlan_publish_port_class(port_list[p]);
+    }
+
+    vlan_release_lock();
+
+    if (statuses) {
+        for (; i < count; i++) {
+            statuses[i] = STATUS_NOT_EXECUTED;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief Add a list of ports to VLANs, each with its own membership type
+ *
+ * @param members Memberships to add
+ * @param count Number of memberships
+ * @param stop_on_error Stop at the first membership that fails
+ * @param statuses Status of each membership, may be NULL
+ * @return status_t Status code
+ */
+status_t vlan_add_members_bulk(const vlan_member_t *members, uint32_t count, bool stop_on_error,
+                               status_t *statuses) {
+    return vlan_update_members(members, count, true, stop_on_error, statuses);
+}
+
+/**
+ * @brief Remove a list of ports from VLANs
+ *
+ * @param members Memberships to remove; member_type is ignored
+ * @param count Number of memberships
+ * @param stop_on_error Stop at the first membership that fails
+ * @param statuses Status of each membership, may be NULL
+ * @return status_t Status code
+ */
+status_t vlan_remove_members_bulk(const vlan_member_t *members, uint32_t count, bool stop_on_error,
+                                  status_t *statuses) {
+    return vlan_update_members(members, count, false, stop_on_error, statuses);
+}
+
+/**
+ * @brief Get the set of active VLANs
+ *
+ * @param bitmap Output VLAN ID bitmap of VLAN_ID_WORDS words
+ * @return status_t Status code
+ */
+status_t vlan_get_active_bitmap(uint64_t *bitmap) {
+    uint32_t i;
+
+    if (!bitmap) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    memset(bitmap, 0, VLAN_ID_WORDS * sizeof(uint64_t));
+
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    for (i = 0; i < VLAN_MAX_COUNT; i++) {
+        if (g_vlan_state.vlans[i].active) {
+            bitmap_set(bitmap, i);
+        }
+    }
+
+    vlan_release_lock();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the member ports of a VLAN as bitmaps
+ *
+ * @param vlan_id VLAN ID
+ * @param members Output bitmap of all member ports, may be NULL
+ * @param untagged Output bitmap of untagged member ports, may be NULL
+ * @return status_t STATUS_SUCCESS, STATUS_NOT_FOUND if the VLAN is not active
+ */
+status_t vlan_get_member_bitmaps(vlan_id_t vlan_id, vlan_port_bitmap_t *members,
+                                 vlan_port_bitmap_t *untagged) {
+    if (!is_vlan_id_valid(vlan_id)) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    const vlan_internal_entry_t *vlan = &g_vlan_state.vlans[vlan_id];
+    if (!vlan->active) {
+        vlan_release_lock();
+        return STATUS_NOT_FOUND;
+    }
+    if (members) {
+        memcpy(members->w, vlan->port_membership, sizeof(members->w));
+    }
+    if (untagged) {
+        memcpy(untagged->w, vlan->untagged_ports, sizeof(untagged->w));
+    }
+
+    vlan_release_lock();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Replace the allowed VLAN set of a trunk or hybrid port
+ *
+ * @param port_id Port ID
+ * @param bitmap VLAN ID bitmap of VLAN_ID_WORDS words
+ * @return status_t Status code
+ */
+status_t vlan_set_trunk_allowed_bitmap(port_id_t port_id, const uint64_t *bitmap) {
+    port_vlan_config_t *config;
+    uint32_t count = 0;
+
+    if (!bitmap) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    if (!vlan_port_valid(port_id)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
+        vlan_release_lock();
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    config = &g_vlan_state.port_configs[port_id];
+
+    if (config->mode != PORT_VLAN_MODE_TRUNK && config->mode != PORT_VLAN_MODE_HYBRID) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Port %d is not in trunk or hybrid mode", port_id);
+        vlan_release_lock();
+        return ERROR_INVALID_STATE;
+    }
+
+    if (is_vlan_id_valid(config->native_vlan) && !bitmap_test(bitmap, config->native_vlan)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Cannot disallow native VLAN %d on port %d", config->native_vlan, port_id);
+        vlan_release_lock();
+        return STATUS_PERMISSION_DENIED;
+    }
+
+    bitmap_copy(config->allowed_vlans, bitmap, VLAN_ID_WORDS);
+    bitmap_clear(config->allowed_vlans, VLAN_ID_INVALID);
+    count = bitmap_count(config->allowed_vlans, VLAN_ID_WORDS);
+    vlan_publish_port_class(port_id);
+
+    LOG_INFO(LOG_CATEGORY_L2, "VLAN: Set %d allowed VLANs on trunk port %d", count, port_id);
+
+    vlan_release_lock();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Set the QinQ role of a port
+ *
+ * @param port_id Port ID
+ * @param mode QinQ role
+ * @return status_t Status code
+ */
+status_t vlan_set_port_qinq_mode(port_id_t port_id, vlan_qinq_mode_t mode) {
+    if (mode != VLAN_QINQ_NONE && mode != VLAN_QINQ_CUSTOMER && mode != VLAN_QINQ_PROVIDER) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    if (!vlan_port_valid(port_id)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
+        vlan_release_lock();
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    g_vlan_state.port_configs[port_id].qinq_mode = mode;
+    if (mode == VLAN_QINQ_PROVIDER) {
+        bitmap_set(g_vlan_state.qinq_provider, port_id);
+    } else {
+        bitmap_clear(g_vlan_state.qinq_provider, port_id);
+    }
+    vlan_publish_port_class(port_id);
+
+    LOG_INFO(LOG_CATEGORY_L2, "VLAN: Port %d QinQ mode set to %s", port_id,
+             mode == VLAN_QINQ_CUSTOMER ? "customer" : mode == VLAN_QINQ_PROVIDER ? "provider" : "none");
+
+    vlan_release_lock();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Map a C-VLAN to an S-VLAN on a customer edge port
+ *
+ * @param port_id Port ID
+ * @param c_vlan Customer VLAN ID
+ * @param s_vlan Service VLAN ID, or VLAN_ID_INVALID to remove the mapping
+ * @return status_t Status code
+ */
+status_t vlan_set_svlan_translation(port_id_t port_id, vlan_id_t c_vlan, vlan_id_t s_vlan) {
+    port_vlan_config_t *config;
+
+    if (!is_vlan_id_valid(c_vlan) || (s_vlan != VLAN_ID_INVALID && !is_vlan_id_valid(s_vlan))) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid translation C-VLAN %d to S-VLAN %d", c_vlan, s_vlan);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    if (!vlan_port_valid(port_id)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
+        vlan_release_lock();
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    config = &g_vlan_state.port_configs[port_id];
+
+    if (!config->s_vlan_map) {
+        if (s_vlan == VLAN_ID_INVALID) {
+            vlan_release_lock();
+            return STATUS_SUCCESS;
+        }
+        config->s_vlan_map = (vlan_id_t *)mem_calloc(MEM_TAG_VLAN, VLAN_MAX_COUNT, sizeof(vlan_id_t));
+        if (!config->s_vlan_map) {
+            LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Failed to allocate S-VLAN table for port %d", port_id);
+            vlan_release_lock();
+            return STATUS_NO_MEMORY;
+        }
+    }
+
+    config->s_vlan_map[c_vlan] = s_vlan;
+    if (config->qinq_mode == VLAN_QINQ_CUSTOMER) {
+        vlan_publish_port_class(port_id);
+    }
+
+    if (s_vlan == VLAN_ID_INVALID) {
+        LOG_INFO(LOG_CATEGORY_L2, "VLAN: Port %d C-VLAN %d translation removed", port_id, c_vlan);
+    } else {
+        LOG_INFO(LOG_CATEGORY_L2, "VLAN: Port %d C-VLAN %d mapped to S-VLAN %d", port_id, c_vlan, s_vlan);
+    }
+
+    vlan_release_lock();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Translate a received VID to a VLAN on a port
+ *
+ * @param port_id Port ID
+ * @param wire_vid VID as received on the wire
+ * @param vlan_id Internal VLAN ID, or VLAN_ID_INVALID to remove the entry
+ * @return status_t Status code
+ */
+status_t vlan_set_ingress_translation(port_id_t port_id, vlan_id_t wire_vid, vlan_id_t vlan_id) {
+    port_vlan_config_t *config;
+
+    if (!is_vlan_id_valid(wire_vid) || (vlan_id != VLAN_ID_INVALID && !is_vlan_id_valid(vlan_id))) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid ingress translation VID %d to VLAN %d", wire_vid, vlan_id);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    if (!vlan_port_valid(port_id)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
+        vlan_release_lock();
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    config = &g_vlan_state.port_configs[port_id];
+
+    if (!config->ingress_xlate) {
+        if (vlan_id == VLAN_ID_INVALID) {
+            vlan_release_lock();
+            return STATUS_SUCCESS;
+        }
+        config->ingress_xlate = (vlan_id_t *)mem_calloc(MEM_TAG_VLAN, VLAN_MAX_COUNT, sizeof(vlan_id_t));
+        if (!config->ingress_xlate) {
+            LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Failed to allocate ingress translation table for port %d", port_id);
+            vlan_release_lock();
+            return STATUS_NO_MEMORY;
+        }
+    }
+
+    config->ingress_xlate[wire_vid] = vlan_id;
+    if (config->qinq_mode != VLAN_QINQ_CUSTOMER) {
+        vlan_publish_port_class(port_id);
+    }
+
+    if (vlan_id == VLAN_ID_INVALID) {
+        LOG_INFO(LOG_CATEGORY_L2, "VLAN: Port %d ingress translation of VID %d removed", port_id, wire_vid);
+    } else {
+        LOG_INFO(LOG_CATEGORY_L2, "VLAN: Port %d ingress VID %d mapped to VLAN %d", port_id, wire_vid, vlan_id);
+    }
+
+    vlan_release_lock();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Translate a VLAN to a transmitted VID on a port
+ *
+ * @param port_id Port ID
+ * @param vlan_id Internal VLAN ID
+ * @param wire_vid VID to transmit, or VLAN_ID_INVALID to remove the entry
+ * @return status_t Status code
+ */
+status_t vlan_set_egress_translation(port_id_t port_id, vlan_id_t vlan_id, vlan_id_t wire_vid) {
+    port_vlan_config_t *config;
+
+    if (!is_vlan_id_valid(vlan_id) || (wire_vid != VLAN_ID_INVALID && !is_vlan_id_valid(wire_vid))) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid egress translation VLAN %d to VID %d", vlan_id, wire_vid);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    vlan_acquire_lock();
+
+    if (!g_vlan_state.initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Module not initialized");
+        vlan_release_lock();
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    if (!vlan_port_valid(port_id)) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Invalid port ID %d", port_id);
+        vlan_release_lock();
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (!g_vlan_state.vlans[vlan_id].active) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VLAN: VLAN %d does not exist", vlan_id);
+        vlan_release_lock();
+        return STATUS_NOT_FOUND;
+    }
+
+    // A translation back to the VLAN's own VID is the same as none
+    if (wire_vid == vlan_id) {
+        wire_vid = VLAN_ID_INVALID;
+    }
+
+    config = &g_vlan_state.port_configs[port_id];
+
+    if (!config->egress_xlate) {
+        if (wire_vid == VLAN_ID_INVALID) {
+            vlan_release_lock();
+            return STATUS_SUCCESS;
+        }
+        config->egress_xlate = (vlan_id_t *)mem_calloc(MEM_TAG_VLAN, VLAN_MAX_COUNT, sizeof(vlan_id_t));
+        if (!config->egress_xlate) {
+            LOG_ERROR(LOG_CATEGORY_L2, "VLAN: Failed to allocate egress translation table for port %d", port_id);
+            vlan_release_lock();
+            return STATUS_NO_MEMORY;
+        }
+    }
+
+    config->egress_xlate[vlan_id] = wire_vid;
+    if (wire_vid == VLAN_ID_INVALID) {
+        bitmap_clear(g_vlan_state.vlans[vlan_id].egress_xlate_ports, port_id);
+        LOG_INFO(LOG_CATEGORY_L2, "VLAN: Port %d egress translation of VLAN %d removed", port_id, vlan_id);
+    } else {
+        bitmap_set(g_vlan_state.vlans[vlan_id].egress_xlate_ports, port_id);
+        LOG_INFO(LOG_CATEGORY_L2, "VLAN: Port %d egress VLAN %d mapped to VID %d", port_id, vlan_id, wire_vid);
+    }
+
+    vlan_release_lock();
+    return STATUS_SUCCESS;
+}
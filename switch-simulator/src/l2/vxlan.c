@@ -0,0 +1,923 @@
+/**
+ * @file vxlan.c
+ * @brief Implementation of the VXLAN tunnel endpoint
+ *
+ * The data path reads without a lock. The outer headers of a tunnel are
+ * an immutable template, replaced with one pointer exchange and freed
+ * through RCU, so a sender copies either the headers before a change or
+ * the ones after. The remote address of each tunnel sits in a packed
+ * array scanned on decapsulation; a tunnel's address is cleared there
+ * before its template is retired. The VNI and VLAN maps and the flood
+ * lists are single words, stored atomically; VNI pages are allocated
+ * under the module lock and only freed with the module.
+ *
+ * Everything else is written under the module lock.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/config.h"
+#include "common/logging.h"
+#include "common/threading.h"
+#include "common/rcu.h"
+#include "common/stats_shard.h"
+#include "common/switch_context.h"
+#include "hal/packet_offload.h"
+#include "l2/lag.h"
+#include "l2/mac_table.h"
+#include "l2/vlan.h"
+#include "l2/vxlan.h"
+
+/**
+ * @brief Outer header layout
+ */
+#define VXLAN_ETH_HLEN          14
+#define VXLAN_IP_HLEN           20
+#define VXLAN_UDP_HLEN          8
+#define VXLAN_IP_OFF            VXLAN_ETH_HLEN
+#define VXLAN_UDP_OFF           (VXLAN_IP_OFF + VXLAN_IP_HLEN)
+#define VXLAN_HDR_OFF           (VXLAN_UDP_OFF + VXLAN_UDP_HLEN)
+#define VXLAN_ETH_ADDRS_LEN     (2 * MAC_ADDR_LEN)
+#define VXLAN_VLAN_TAG_LEN      4
+#define VXLAN_FLAG_VNI          0x08    /**< I flag: the VNI is valid */
+#define VXLAN_IP_DF             0x4000
+#define VXLAN_IP_PROTO_UDP      17
+
+/**
+ * @brief UDP source ports carrying the inner flow hash (RFC 7348 section 5)
+ */
+#define VXLAN_SPORT_BASE        49152
+#define VXLAN_SPORT_MASK        0x3FFF
+
+/**
+ * @brief Two-level VNI table: 4096 pages of 4096 VLANs
+ */
+#define VXLAN_VNI_PAGE_SHIFT    12
+#define VXLAN_VNI_PAGE_SIZE     (1u << VXLAN_VNI_PAGE_SHIFT)
+#define VXLAN_VNI_PAGES         ((VXLAN_VNI_MAX >> VXLAN_VNI_PAGE_SHIFT) + 1)
+
+/**
+ * @brief Sharded counters: per tunnel, then the VTEP's
+ */
+enum {
+    VXLAN_CTR_ENCAP_PACKETS,
+    VXLAN_CTR_ENCAP_BYTES,
+    VXLAN_CTR_DECAP_PACKETS,
+    VXLAN_CTR_DECAP_BYTES,
+    VXLAN_TUNNEL_CTRS
+};
+#define VXLAN_CTR(index, ctr)       ((size_t)(index) * VXLAN_TUNNEL_CTRS + (ctr))
+#define VXLAN_CTR_UNKNOWN_VTEP      ((size_t)CONFIG_VXLAN_MAX_TUNNELS * VXLAN_TUNNEL_CTRS)
+#define VXLAN_CTR_UNKNOWN_VNI       (VXLAN_CTR_UNKNOWN_VTEP + 1)
+#define VXLAN_CTR_BAD_HEADER        (VXLAN_CTR_UNKNOWN_VTEP + 2)
+#define VXLAN_CTR_ENCAP_ERRORS      (VXLAN_CTR_UNKNOWN_VTEP + 3)
+#define VXLAN_CTR_COUNT             (VXLAN_CTR_UNKNOWN_VTEP + 4)
+
+/**
+ * @brief Outer headers of a tunnel, immutable once published
+ *
+ * Lengths, checksum, source port and VNI are zero in hdr; ip_sum is the
+ * ones' complement sum of the IPv4 header as it stands.
+ */
+typedef struct {
+    rcu_head_t rcu;
+    port_id_t underlay_port;
+    uint32_t ip_sum;
+    uint8_t hdr[VXLAN_ENCAP_LEN];
+} vxlan_encap_t;
+
+/**
+ * @brief One tunnel
+ */
+typedef struct {
+    bool active;
+    vxlan_tunnel_config_t config;
+} vxlan_tunnel_t;
+
+/**
+ * @brief VXLAN state of one switch instance
+ */
+typedef struct {
+    bool initialized;
+    spinlock_t lock;                                /**< Serializes everything but the data path */
+    uint32_t local_ip;                              /**< 0 while the VTEP is disabled */
+    mac_addr_t local_mac;
+    uint16_t udp_port;
+    uint32_t remote_ip[CONFIG_VXLAN_MAX_TUNNELS];   /**< Remote VTEP of each tunnel, 0 if none */
+    vxlan_encap_t *encap[CONFIG_VXLAN_MAX_TUNNELS]; /**< Published templates (RCU), NULL without a VTEP */
+    vxlan_tunnel_t tunnels[CONFIG_VXLAN_MAX_TUNNELS];
+    uint32_t vlan_vni[MAX_VLANS];                   /**< VNI of each VLAN, 0 if none */
+    uint64_t flood[MAX_VLANS];                      /**< Tunnels each VLAN floods to */
+    uint16_t *vni_vlan[VXLAN_VNI_PAGES];            /**< VLAN of each VNI, 0 if none */
+    stats_shard_set_t *counters;                    /**< VXLAN_CTR_COUNT counters */
+} vxlan_state_t;
+
+/**
+ * @brief VXLAN state of each switch instance
+ *
+ * Instance 0 is static; vxlan_init() allocates the others.
+ */
+static vxlan_state_t g_vxlan_state_default;
+static vxlan_state_t *g_vxlan_states[CONFIG_MAX_SWITCH_INSTANCES] = { &g_vxlan_state_default };
+
+/**
+ * @brief State of the calling thread's instance, NULL if never initialized
+ */
+static inline vxlan_state_t *vxlan_state(void) {
+    return g_vxlan_states[switch_context_current()];
+}
+
+static inline void vxlan_write16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static inline void vxlan_write32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static inline uint16_t vxlan_read16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static inline uint32_t vxlan_read32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void vxlan_encap_free(rcu_head_t *head) {
+    free((vxlan_encap_t *)((char *)head - offsetof(vxlan_encap_t, rcu)));
+}
+
+/**
+ * @brief Tunnel index of a port ID, -1 if no tunnel has been created on it
+ */
+static int vxlan_lookup(vxlan_state_t *st, port_id_t tunnel_port) {
+    if (!vxlan_port_is_tunnel(tunnel_port) || !st->tunnels[tunnel_port - CONFIG_VXLAN_PORT_BASE].active) {
+        return -1;
+    }
+    return (int)(tunnel_port - CONFIG_VXLAN_PORT_BASE);
+}
+
+/**
+ * @brief Build and publish the outer headers of a tunnel
+ *
+ * Must be called with the module lock held. Without a VTEP address the
+ * tunnel has no template and sends nothing.
+ */
+static status_t vxlan_publish(vxlan_state_t *st, uint32_t index) {
+    const vxlan_tunnel_config_t *config = &st->tunnels[index].config;
+    vxlan_encap_t *next = NULL;
+    vxlan_encap_t *cur;
+
+    if (st->tunnels[index].active && st->local_ip != 0) {
+        uint8_t *eth, *ip, *udp, *vx;
+
+        next = (vxlan_encap_t *)calloc(1, sizeof(vxlan_encap_t));
+        if (!next) {
+            LOG_ERROR(LOG_CATEGORY_L2, "VXLAN: Failed to build headers of tunnel %u", index);
+            return STATUS_NO_MEMORY;
+        }
+        eth = next->hdr;
+        ip = next->hdr + VXLAN_IP_OFF;
+        udp = next->hdr + VXLAN_UDP_OFF;
+        vx = next->hdr + VXLAN_HDR_OFF;
+
+        memcpy(eth, config->next_hop_mac.addr, MAC_ADDR_LEN);
+        memcpy(eth + MAC_ADDR_LEN, st->local_mac.addr, MAC_ADDR_LEN);
+        vxlan_write16(eth + 12, ETHERTYPE_IP);
+
+        // Atomic datagrams: DF set, so the ID may stay zero (RFC 6864)
+        ip[0] = 0x45;
+        ip[1] = (uint8_t)(config->dscp << 2);
+        vxlan_write16(ip + 6, VXLAN_IP_DF);
+        ip[8] = config->ttl ? config->ttl : VXLAN_DEFAULT_TTL;
+        ip[9] = VXLAN_IP_PROTO_UDP;
+        vxlan_write32(ip + 12, st->local_ip);
+        vxlan_write32(ip + 16, config->remote_ip);
+        next->ip_sum = packet_csum_add(0, ip, VXLAN_IP_HLEN);
+
+        vxlan_write16(udp + 2, st->udp_port);
+        vx[0] = VXLAN_FLAG_VNI;
+        next->underlay_port = config->underlay_port;
+    }
+
+    cur = __atomic_exchange_n(&st->encap[index], next, __ATOMIC_ACQ_REL);
+    if (cur) {
+        rcu_retire(&cur->rcu, vxlan_encap_free);
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Write the outer headers of one frame: the template and its patches
+ *
+ * @param hdr VXLAN_ENCAP_LEN bytes in front of the inner frame
+ * @param encap Template
+ * @param vni VNI
+ * @param inner_len Bytes of the inner frame
+ * @param sport UDP source port
+ */
+static inline void vxlan_write_headers(uint8_t *hdr, const vxlan_encap_t *encap, uint32_t vni,
+                                       uint32_t inner_len, uint16_t sport) {
+    uint32_t ip_len = VXLAN_IP_HLEN + VXLAN_UDP_HLEN + VXLAN_HDR_LEN + inner_len;
+
+    memcpy(hdr, encap->hdr, VXLAN_ENCAP_LEN);
+    // The length was zero in the precomputed sum, adding it is the whole update
+    vxlan_write16(hdr + VXLAN_IP_OFF + 2, (uint16_t)ip_len);
+    vxlan_write16(hdr + VXLAN_IP_OFF + 10, packet_csum_fold(encap->ip_sum + ip_len));
+    vxlan_write16(hdr + VXLAN_UDP_OFF, sport);
+    vxlan_write16(hdr + VXLAN_UDP_OFF + 4, (uint16_t)(ip_len - VXLAN_IP_HLEN));
+    hdr[VXLAN_HDR_OFF + 4] = (uint8_t)(vni >> 16);
+    hdr[VXLAN_HDR_OFF + 5] = (uint8_t)(vni >> 8);
+    hdr[VXLAN_HDR_OFF + 6] = (uint8_t)vni;
+}
+
+/**
+ * @brief UDP source port of a frame, from the hash of its inner flow
+ */
+static inline uint16_t vxlan_source_port(packet_buffer_t *packet) {
+    return (uint16_t)(VXLAN_SPORT_BASE | (packet_flow_hash(packet) & VXLAN_SPORT_MASK));
+}
+
+/**
+ * @brief Whether the frame's outermost header after the MACs is a VLAN tag
+ */
+static inline bool vxlan_frame_tagged(const packet_buffer_t *packet) {
+    uint16_t tpid = packet_vlan_tpid(packet);
+    return tpid == ETHERTYPE_VLAN || tpid == ETHERTYPE_QINQ;
+}
+
+/**
+ * @brief Metadata of a frame leaving into the underlay
+ */
+static void vxlan_outer_metadata(packet_buffer_t *packet, port_id_t underlay_port) {
+    packet->metadata.port = underlay_port;
+    packet->metadata.direction = PACKET_DIR_TX;
+    packet->metadata.ethertype = ETHERTYPE_IP;
+    packet->metadata.is_tagged = false;
+    packet->metadata.offload &= (uint16_t)~(PACKET_OFFLOAD_TX_MASK | PACKET_OFFLOAD_RX_MASK);
+    packet->metadata.tso_mss = 0;
+    packet_invalidate_parse(packet);
+}
+
+/**
+ * @brief Initialize the VXLAN module of the current switch instance
+ *
+ * @return status_t Status code
+ */
+status_t vxlan_init(void) {
+    uint32_t instance = switch_context_current();
+    vxlan_state_t *st;
+    status_t status;
+
+    if (g_vxlan_states[instance] == NULL) {
+        g_vxlan_states[instance] = (vxlan_state_t *)calloc(1, sizeof(vxlan_state_t));
+        if (!g_vxlan_states[instance]) {
+            LOG_ERROR(LOG_CATEGORY_L2, "VXLAN: Failed to allocate state of switch instance %u", instance);
+            return STATUS_NO_MEMORY;
+        }
+    }
+    st = g_vxlan_states[instance];
+
+    if (st->initialized) {
+        LOG_WARNING(LOG_CATEGORY_L2, "VXLAN: Module already initialized");
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    status = stats_shard_create(VXLAN_CTR_COUNT, &st->counters);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VXLAN: Failed to allocate counters: %d", status);
+        return status;
+    }
+    spinlock_init(&st->lock);
+    st->udp_port = VXLAN_UDP_PORT;
+    st->initialized = true;
+
+    LOG_INFO(LOG_CATEGORY_L2, "VXLAN: Module initialized");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Delete every tunnel and free the module state of the current instance
+ *
+ * @return status_t Status code
+ */
+status_t vxlan_deinit(void) {
+    uint32_t instance = switch_context_current();
+    vxlan_state_t *st = g_vxlan_states[instance];
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    spinlock_acquire(&st->lock);
+    for (uint32_t i = 0; i < CONFIG_VXLAN_MAX_TUNNELS; i++) {
+        vxlan_encap_t *encap = __atomic_exchange_n(&st->encap[i], NULL, __ATOMIC_ACQ_REL);
+        if (encap) {
+            rcu_retire(&encap->rcu, vxlan_encap_free);
+        }
+    }
+    st->initialized = false;
+    spinlock_release(&st->lock);
+
+    rcu_synchronize();
+    for (uint32_t p = 0; p < VXLAN_VNI_PAGES; p++) {
+        free(st->vni_vlan[p]);
+    }
+    stats_shard_destroy(st->counters);
+    if (instance != SWITCH_INSTANCE_DEFAULT) {
+        g_vxlan_states[instance] = NULL;
+        free(st);
+    } else {
+        memset(st, 0, sizeof(*st));
+    }
+
+    LOG_INFO(LOG_CATEGORY_L2, "VXLAN: Module cleaned up");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Set the local VTEP and rebuild the headers of every tunnel
+ *
+ * @param local_ip Local address, host order, 0 to disable
+ * @param local_mac Outer source MAC
+ * @param udp_port UDP port, 0 for the IANA port
+ * @return status_t Status code
+ */
+status_t vxlan_set_vtep(uint32_t local_ip, const mac_addr_t *local_mac, uint16_t udp_port) {
+    vxlan_state_t *st = vxlan_state();
+    status_t status = STATUS_SUCCESS;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (local_ip != 0 && (!local_mac || (local_mac->addr[0] & 0x01))) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    if (local_mac) {
+        st->local_mac = *local_mac;
+    }
+    st->udp_port = udp_port ? udp_port : VXLAN_UDP_PORT;
+    __atomic_store_n(&st->local_ip, local_ip, __ATOMIC_RELEASE);
+    for (uint32_t i = 0; i < CONFIG_VXLAN_MAX_TUNNELS && status == STATUS_SUCCESS; i++) {
+        if (st->tunnels[i].active) {
+            status = vxlan_publish(st, i);
+        }
+    }
+    spinlock_release(&st->lock);
+
+    LOG_INFO(LOG_CATEGORY_L2, "VXLAN: VTEP %u.%u.%u.%u, UDP port %u",
+             local_ip >> 24, (local_ip >> 16) & 0xFF, (local_ip >> 8) & 0xFF, local_ip & 0xFF,
+             udp_port ? udp_port : VXLAN_UDP_PORT);
+    return status;
+}
+
+/**
+ * @brief Create a tunnel to a remote VTEP
+ *
+ * @param tunnel_port Tunnel port ID
+ * @param config Parameters
+ * @return status_t Status code
+ */
+status_t vxlan_tunnel_create(port_id_t tunnel_port, const vxlan_tunnel_config_t *config) {
+    vxlan_state_t *st = vxlan_state();
+    uint32_t index;
+    status_t status;
+
+    if (!st || !st->initialized) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VXLAN: Module not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!vxlan_port_is_tunnel(tunnel_port) || !config || config->remote_ip == 0 ||
+        config->dscp > 63 || (config->next_hop_mac.addr[0] & 0x01) ||
+        (config->underlay_port >= CONFIG_VXLAN_PORT_BASE && !lag_port_is_lag(config->underlay_port))) {
+        LOG_ERROR(LOG_CATEGORY_L2, "VXLAN: Invalid tunnel port %u or configuration", tunnel_port);
+        return STATUS_INVALID_PARAMETER;
+    }
+    index = tunnel_port - CONFIG_VXLAN_PORT_BASE;
+
+    spinlock_acquire(&st->lock);
+    if (st->tunnels[index].active) {
+        spinlock_release(&st->lock);
+        return STATUS_ALREADY_EXISTS;
+    }
+    for (uint32_t i = 0; i < CONFIG_VXLAN_MAX_TUNNELS; i++) {
+        if (st->tunnels[i].active && st->tunnels[i].config.remote_ip == config->remote_ip) {
+            spinlock_release(&st->lock);
+            return STATUS_RESOURCE_BUSY;
+        }
+    }
+    stats_shard_clear(st->counters, VXLAN_CTR(index, 0), VXLAN_TUNNEL_CTRS);
+    st->tunnels[index].config = *config;
+    st->tunnels[index].active = true;
+    status = vxlan_publish(st, index);
+    if (status != STATUS_SUCCESS) {
+        st->tunnels[index].active = false;
+        spinlock_release(&st->lock);
+        return status;
+    }
+    __atomic_store_n(&st->remote_ip[index], config->remote_ip, __ATOMIC_RELEASE);
+    spinlock_release(&st->lock);
+
+    LOG_INFO(LOG_CATEGORY_L2, "VXLAN: Created tunnel port %u to %u.%u.%u.%u over port %u", tunnel_port,
+             config->remote_ip >> 24, (config->remote_ip >> 16) & 0xFF, (config->remote_ip >> 8) & 0xFF,
+             config->remote_ip & 0xFF, config->underlay_port);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Delete a tunnel
+ *
+ * @param tunnel_port Tunnel
+ * @return status_t Status code
+ */
+status_t vxlan_tunnel_delete(port_id_t tunnel_port) {
+    vxlan_state_t *st = vxlan_state();
+    uint64_t bit;
+    int index;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    spinlock_acquire(&st->lock);
+    index = vxlan_lookup(st, tunnel_port);
+    if (index < 0) {
+        spinlock_release(&st->lock);
+        return STATUS_NOT_FOUND;
+    }
+    bit = 1ULL << index;
+    __atomic_store_n(&st->remote_ip[index], 0, __ATOMIC_RELEASE);
+    for (uint32_t v = 0; v < MAX_VLANS; v++) {
+        if (st->flood[v] & bit) {
+            __atomic_store_n(&st->flood[v], st->flood[v] & ~bit, __ATOMIC_RELEASE);
+        }
+    }
+    st->tunnels[index].active = false;
+    (void)vxlan_publish(st, (uint32_t)index);
+    spinlock_release(&st->lock);
+
+    // Entries learned behind the remote VTEP would blackhole its hosts
+    mac_table_flush(0, tunnel_port, true);
+
+    LOG_INFO(LOG_CATEGORY_L2, "VXLAN: Deleted tunnel port %u", tunnel_port);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the parameters of a tunnel
+ *
+ * @param tunnel_port Tunnel
+ * @param config Parameters
+ * @return status_t Status code
+ */
+status_t vxlan_tunnel_get_config(port_id_t tunnel_port, vxlan_tunnel_config_t *config) {
+    vxlan_state_t *st = vxlan_state();
+    int index;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!config) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    index = vxlan_lookup(st, tunnel_port);
+    if (index >= 0) {
+        *config = st->tunnels[index].config;
+    }
+    spinlock_release(&st->lock);
+    return index >= 0 ? STATUS_SUCCESS : STATUS_NOT_FOUND;
+}
+
+/**
+ * @brief Get the counters of a tunnel
+ *
+ * @param tunnel_port Tunnel
+ * @param stats Counters
+ * @return status_t Status code
+ */
+status_t vxlan_tunnel_get_stats(port_id_t tunnel_port, vxlan_tunnel_stats_t *stats) {
+    vxlan_state_t *st = vxlan_state();
+    uint64_t values[VXLAN_TUNNEL_CTRS];
+    int index;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    index = vxlan_lookup(st, tunnel_port);
+    if (index < 0) {
+        return STATUS_NOT_FOUND;
+    }
+
+    stats_shard_fold(st->counters, VXLAN_CTR(index, 0), VXLAN_TUNNEL_CTRS, values);
+    stats->encap_packets = values[VXLAN_CTR_ENCAP_PACKETS];
+    stats->encap_bytes = values[VXLAN_CTR_ENCAP_BYTES];
+    stats->decap_packets = values[VXLAN_CTR_DECAP_PACKETS];
+    stats->decap_bytes = values[VXLAN_CTR_DECAP_BYTES];
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Map a VNI to a VLAN
+ *
+ * @param vni VNI
+ * @param vlan_id VLAN
+ * @return status_t Status code
+ */
+status_t vxlan_map_vni(uint32_t vni, vlan_id_t vlan_id) {
+    vxlan_state_t *st = vxlan_state();
+    uint16_t *page;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (vni == 0 || vni > VXLAN_VNI_MAX || vlan_id == 0 || vlan_id > VLAN_ID_MAX) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    page = st->vni_vlan[vni >> VXLAN_VNI_PAGE_SHIFT];
+    if ((page && page[vni & (VXLAN_VNI_PAGE_SIZE - 1)] != 0) || st->vlan_vni[vlan_id] != 0) {
+        spinlock_release(&st->lock);
+        return STATUS_RESOURCE_BUSY;
+    }
+    if (!page) {
+        page = (uint16_t *)calloc(VXLAN_VNI_PAGE_SIZE, sizeof(uint16_t));
+        if (!page) {
+            spinlock_release(&st->lock);
+            return STATUS_NO_MEMORY;
+        }
+        __atomic_store_n(&st->vni_vlan[vni >> VXLAN_VNI_PAGE_SHIFT], page, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&page[vni & (VXLAN_VNI_PAGE_SIZE - 1)], vlan_id, __ATOMIC_RELEASE);
+    __atomic_store_n(&st->vlan_vni[vlan_id], vni, __ATOMIC_RELEASE);
+    spinlock_release(&st->lock);
+
+    LOG_INFO(LOG_CATEGORY_L2, "VXLAN: VNI %u mapped to VLAN %u", vni, vlan_id);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Remove the mapping of a VNI
+ *
+ * @param vni VNI
+ * @return status_t Status code
+ */
+status_t vxlan_unmap_vni(uint32_t vni) {
+    vxlan_state_t *st = vxlan_state();
+    uint16_t *page;
+    vlan_id_t vlan_id;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (vni == 0 || vni > VXLAN_VNI_MAX) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    page = st->vni_vlan[vni >> VXLAN_VNI_PAGE_SHIFT];
+    vlan_id = page ? page[vni & (VXLAN_VNI_PAGE_SIZE - 1)] : 0;
+    if (vlan_id == 0) {
+        spinlock_release(&st->lock);
+        return STATUS_NOT_FOUND;
+    }
+    __atomic_store_n(&page[vni & (VXLAN_VNI_PAGE_SIZE - 1)], 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&st->vlan_vni[vlan_id], 0, __ATOMIC_RELEASE);
+    spinlock_release(&st->lock);
+
+    LOG_INFO(LOG_CATEGORY_L2, "VXLAN: VNI %u unmapped", vni);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief VNI a VLAN is carried in
+ *
+ * @param vlan_id VLAN
+ * @return VNI, 0 if none
+ */
+uint32_t vxlan_vlan_vni(vlan_id_t vlan_id) {
+    vxlan_state_t *st = vxlan_state();
+
+    if (!st || vlan_id >= MAX_VLANS) {
+        return 0;
+    }
+    return __atomic_load_n(&st->vlan_vni[vlan_id], __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Add a tunnel to or remove it from the flood list of a VLAN
+ *
+ * @param tunnel_port Tunnel
+ * @param vlan_id VLAN
+ * @param flood Whether the tunnel gets the VLAN's flooded frames
+ * @return status_t Status code
+ */
+status_t vxlan_set_flood(port_id_t tunnel_port, vlan_id_t vlan_id, bool flood) {
+    vxlan_state_t *st = vxlan_state();
+    uint64_t mask;
+    int index;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (vlan_id == 0 || vlan_id > VLAN_ID_MAX) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    index = vxlan_lookup(st, tunnel_port);
+    if (index < 0) {
+        spinlock_release(&st->lock);
+        return STATUS_NOT_FOUND;
+    }
+    mask = flood ? st->flood[vlan_id] | (1ULL << index) : st->flood[vlan_id] & ~(1ULL << index);
+    __atomic_store_n(&st->flood[vlan_id], mask, __ATOMIC_RELEASE);
+    spinlock_release(&st->lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Take the inner frame out of a VXLAN frame for the local VTEP
+ *
+ * @param packet Parsed frame
+ * @param tunnel_port Tunnel of the remote VTEP
+ * @param vlan_id VLAN of the VNI
+ * @return status_t Status code
+ */
+status_t vxlan_decap(packet_buffer_t *packet, port_id_t *tunnel_port, vlan_id_t *vlan_id) {
+    vxlan_state_t *st = vxlan_state();
+    const uint8_t *ip, *udp, *vx;
+    const uint16_t *page;
+    uint64_t *ctr;
+    uint32_t local_ip, remote_ip, vni, outer_len, frame_len;
+    uint32_t index;
+    uint16_t vlan;
+
+    // Common case first: not UDP to the VTEP, bridged as is
+    if (!st || !packet || !packet_parsed_has(packet, PACKET_PARSED_L4) ||
+        !packet_has_proto(packet, PACKET_PROTO_IPV4) || packet->metadata.l4_proto != VXLAN_IP_PROTO_UDP ||
+        packet_has_proto(packet, PACKET_PROTO_IP_FRAG)) {
+        return STATUS_NOT_FOUND;
+    }
+    local_ip = __atomic_load_n(&st->local_ip, __ATOMIC_ACQUIRE);
+    outer_len = packet_l4_offset(packet) + VXLAN_UDP_HLEN + VXLAN_HDR_LEN;
+    if (local_ip == 0 || packet->size < outer_len) {
+        return STATUS_NOT_FOUND;
+    }
+    ip = packet_l3_header(packet);
+    udp = packet_l4_header(packet);
+    if (vxlan_read32(ip + 16) != local_ip || vxlan_read16(udp + 2) != st->udp_port ||
+        memcmp(packet->data, st->local_mac.addr, MAC_ADDR_LEN) != 0) {
+        return STATUS_NOT_FOUND;
+    }
+
+    ctr = stats_shard_local(st->counters);
+    vx = udp + VXLAN_UDP_HLEN;
+    frame_len = packet_chain_length(packet);
+    if ((vx[0] & VXLAN_FLAG_VNI) == 0 || frame_len < outer_len + VXLAN_ETH_HLEN) {
+        stats_shard_add(&ctr[VXLAN_CTR_BAD_HEADER], 1);
+        return STATUS_INVALID_PACKET;
+    }
+
+    // A handful of tunnels: a scan of one packed array beats hashing
+    remote_ip = vxlan_read32(ip + 12);
+    for (index = 0; index < CONFIG_VXLAN_MAX_TUNNELS; index++) {
+        if (__atomic_load_n(&st->remote_ip[index], __ATOMIC_RELAXED) == remote_ip) {
+            break;
+        }
+    }
+    if (index == CONFIG_VXLAN_MAX_TUNNELS) {
+        stats_shard_add(&ctr[VXLAN_CTR_UNKNOWN_VTEP], 1);
+        return STATUS_PERMISSION_DENIED;
+    }
+
+    vni = (uint32_t)vx[4] << 16 | (uint32_t)vx[5] << 8 | vx[6];
+    page = __atomic_load_n(&st->vni_vlan[vni >> VXLAN_VNI_PAGE_SHIFT], __ATOMIC_ACQUIRE);
+    vlan = page ? __atomic_load_n(&page[vni & (VXLAN_VNI_PAGE_SIZE - 1)], __ATOMIC_RELAXED) : 0;
+    if (vlan == 0) {
+        stats_shard_add(&ctr[VXLAN_CTR_UNKNOWN_VNI], 1);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // Head-end copies arrive as a header segment and a slice; parsing needs one
+    if (packet->next && packet_linearize(packet) != STATUS_SUCCESS) {
+        stats_shard_add(&ctr[VXLAN_CTR_BAD_HEADER], 1);
+        return STATUS_NO_MEMORY;
+    }
+    packet_pull_header(packet, outer_len, NULL);
+    packet->metadata.offload &= (uint16_t)~PACKET_OFFLOAD_RX_MASK;
+    packet_invalidate_parse(packet);
+    if (packet_parse(packet) != STATUS_SUCCESS) {
+        stats_shard_add(&ctr[VXLAN_CTR_BAD_HEADER], 1);
+        return STATUS_INVALID_PACKET;
+    }
+
+    stats_shard_add(&ctr[VXLAN_CTR(index, VXLAN_CTR_DECAP_PACKETS)], 1);
+    stats_shard_add(&ctr[VXLAN_CTR(index, VXLAN_CTR_DECAP_BYTES)], frame_len);
+    *tunnel_port = VXLAN_PORT_ID(index);
+    *vlan_id = vlan;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Encapsulate a frame for a tunnel in place
+ *
+ * @param packet Parsed frame
+ * @param tunnel_port Tunnel
+ * @param vlan_id VLAN of the frame
+ * @param underlay_port Port to send it out of
+ * @return status_t Status code
+ */
+status_t vxlan_encap(packet_buffer_t *packet, port_id_t tunnel_port, vlan_id_t vlan_id,
+                     port_id_t *underlay_port) {
+    vxlan_state_t *st = vxlan_state();
+    const vxlan_encap_t *encap;
+    uint32_t index, vni, inner_len;
+    uint16_t sport;
+    uint64_t *ctr;
+    uint8_t *hdr;
+    status_t status;
+
+    if (!st || !packet || !underlay_port || !vxlan_port_is_tunnel(tunnel_port) || vlan_id >= MAX_VLANS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    index = tunnel_port - CONFIG_VXLAN_PORT_BASE;
+    vni = __atomic_load_n(&st->vlan_vni[vlan_id], __ATOMIC_ACQUIRE);
+    if (vni == 0) {
+        return STATUS_NOT_FOUND;
+    }
+
+    ctr = stats_shard_local(st->counters);
+    // Inner checksums the egress NIC would fill in sit at the wrong offsets once tunneled
+    sport = vxlan_source_port(packet);
+    status = packet_offload_resolve(packet, 0);
+    if (status == STATUS_SUCCESS && vxlan_frame_tagged(packet)) {
+        status = packet_vlan_pop(packet, NULL);
+    }
+    if (status != STATUS_SUCCESS) {
+        stats_shard_add(&ctr[VXLAN_CTR_ENCAP_ERRORS], 1);
+        return status;
+    }
+    inner_len = packet_chain_length(packet);
+
+    if (rcu_read_lock() != STATUS_SUCCESS) {
+        stats_shard_add(&ctr[VXLAN_CTR_ENCAP_ERRORS], 1);
+        return STATUS_NO_MEMORY;
+    }
+    encap = __atomic_load_n(&st->encap[index], __ATOMIC_ACQUIRE);
+    if (!encap) {
+        rcu_read_unlock();
+        return STATUS_NOT_FOUND;
+    }
+    status = packet_push_header(packet, VXLAN_ENCAP_LEN, &hdr);
+    if (status == STATUS_SUCCESS) {
+        vxlan_write_headers(hdr, encap, vni, inner_len, sport);
+        *underlay_port = encap->underlay_port;
+    }
+    rcu_read_unlock();
+
+    if (status != STATUS_SUCCESS) {
+        stats_shard_add(&ctr[VXLAN_CTR_ENCAP_ERRORS], 1);
+        return status;
+    }
+    vxlan_outer_metadata(packet, *underlay_port);
+    stats_shard_add(&ctr[VXLAN_CTR(index, VXLAN_CTR_ENCAP_PACKETS)], 1);
+    stats_shard_add(&ctr[VXLAN_CTR(index, VXLAN_CTR_ENCAP_BYTES)], inner_len + VXLAN_ENCAP_LEN);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Build the encapsulated copy of a frame for one tunnel
+ *
+ * The header segment holds the outer headers and the inner MACs, built
+ * in its headroom; the rest of the inner frame is a slice of the frame,
+ * after its outer VLAN tag if it has one.
+ *
+ * @return Copy, or NULL if out of descriptors
+ */
+static packet_buffer_t *vxlan_copy(const packet_buffer_t *packet, const vxlan_encap_t *encap,
+                                   uint32_t vni, uint16_t sport, uint32_t skip, uint32_t frame_len) {
+    uint32_t rest_off = VXLAN_ETH_ADDRS_LEN + skip;
+    packet_buffer_t *rest = packet_buffer_slice(packet, rest_off, frame_len - rest_off);
+    packet_buffer_t *copy = packet_segment_alloc();
+    uint8_t *hdr;
+
+    if (!copy || !rest ||
+        packet_push_header(copy, VXLAN_ENCAP_LEN + VXLAN_ETH_ADDRS_LEN, &hdr) != STATUS_SUCCESS ||
+        packet_peek_data(packet, 0, hdr + VXLAN_ENCAP_LEN, VXLAN_ETH_ADDRS_LEN) != STATUS_SUCCESS) {
+        if (copy) {
+            packet_buffer_free(copy);
+        }
+        if (rest) {
+            packet_buffer_free(rest);
+        }
+        return NULL;
+    }
+    vxlan_write_headers(hdr, encap, vni, frame_len - skip, sport);
+    copy->metadata = packet->metadata;
+    vxlan_outer_metadata(copy, encap->underlay_port);
+    packet_chain_append(copy, rest);
+    return copy;
+}
+
+/**
+ * @brief Replicate a frame to the tunnels flooding its VLAN
+ *
+ * @param packet Parsed frame
+ * @param vlan_id VLAN of the frame
+ * @param in_port Port it was received on
+ * @param transmit Sends a copy
+ * @param arg Argument of transmit
+ * @return Number of copies sent
+ */
+uint32_t vxlan_flood(packet_buffer_t *packet, vlan_id_t vlan_id, port_id_t in_port,
+                     vxlan_transmit_fn transmit, void *arg) {
+    vxlan_state_t *st = vxlan_state();
+    uint32_t vni, frame_len, skip, sent = 0;
+    uint64_t tunnels;
+    uint16_t sport;
+    uint64_t *ctr;
+
+    // Split horizon: the remote VTEPs replicate to their own ports
+    if (!st || !packet || !transmit || vlan_id >= MAX_VLANS || vxlan_port_is_tunnel(in_port)) {
+        return 0;
+    }
+    tunnels = __atomic_load_n(&st->flood[vlan_id], __ATOMIC_ACQUIRE);
+    vni = __atomic_load_n(&st->vlan_vni[vlan_id], __ATOMIC_ACQUIRE);
+    if (tunnels == 0 || vni == 0) {
+        return 0;
+    }
+
+    ctr = stats_shard_local(st->counters);
+    if (packet_offload_resolve(packet, 0) != STATUS_SUCCESS) {
+        stats_shard_add(&ctr[VXLAN_CTR_ENCAP_ERRORS], 1);
+        return 0;
+    }
+    sport = vxlan_source_port(packet);
+    skip = vxlan_frame_tagged(packet) ? VXLAN_VLAN_TAG_LEN : 0;
+    frame_len = packet_chain_length(packet);
+    if (frame_len <= VXLAN_ETH_ADDRS_LEN + skip || rcu_read_lock() != STATUS_SUCCESS) {
+        stats_shard_add(&ctr[VXLAN_CTR_ENCAP_ERRORS], 1);
+        return 0;
+    }
+
+    while (tunnels) {
+        uint32_t index = (uint32_t)__builtin_ctzll(tunnels);
+        const vxlan_encap_t *encap = __atomic_load_n(&st->encap[index], __ATOMIC_ACQUIRE);
+        packet_buffer_t *copy;
+
+        tunnels &= tunnels - 1;
+        if (!encap) {
+            continue;
+        }
+        copy = vxlan_copy(packet, encap, vni, sport, skip, frame_len);
+        if (!copy) {
+            stats_shard_add(&ctr[VXLAN_CTR_ENCAP_ERRORS], 1);
+            continue;
+        }
+        stats_shard_add(&ctr[VXLAN_CTR(index, VXLAN_CTR_ENCAP_PACKETS)], 1);
+        stats_shard_add(&ctr[VXLAN_CTR(index, VXLAN_CTR_ENCAP_BYTES)], frame_len - skip + VXLAN_ENCAP_LEN);
+        transmit(encap->underlay_port, copy, arg);
+        sent++;
+    }
+
+    rcu_read_unlock();
+    return sent;
+}
+
+/**
+ * @brief Get the counters of the VTEP
+ *
+ * @param stats Counters
+ * @return status_t Status code
+ */
+status_t vxlan_get_stats(vxlan_stats_t *stats) {
+    vxlan_state_t *st = vxlan_state();
+    uint64_t values[4];
+
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    stats_shard_fold(st->counters, VXLAN_CTR_UNKNOWN_VTEP, 4, values);
+    stats->unknown_vtep = values[0];
+    stats->unknown_vni = values[1];
+    stats->bad_header = values[2];
+    stats->encap_errors = values[3];
+    return STATUS_SUCCESS;
+}
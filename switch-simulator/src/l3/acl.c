@@ -0,0 +1,1209 @@
+/**
+ * @file acl.c
+ * @brief Implementation of the tuple space ACL classifier
+ *
+ * Every rule is reduced to a mask over the packet key (prefix lengths,
+ * exact protocol, exact ports, ingress port and VLAN) and the rule's
+ * fields under that mask. Rules with the same mask form a tuple: one
+ * open-addressed hash table from masked key to the rules carrying it, in
+ * precedence order. Port ranges other than a single port or the full
+ * range are left out of the mask and checked on the rules a probe finds.
+ *
+ * Tuples are created in the order of the first rule of each shape, which
+ * also orders them by the best rule they hold. A burst is classified one
+ * tuple at a time, so a tuple's mask and buckets are loaded once for all
+ * packets, and only packets whose current match a tuple could beat probe
+ * it; the walk ends as soon as no packet can improve.
+ *
+ * The classifier is immutable once published and is replaced through RCU.
+ * Hit counters live in a block per forwarding thread, written only by
+ * that thread and summed by readers.
+ *
+ * PBR policies are classifiers compiled from the same rules, one per
+ * policy ID, with the next-hop group of each rule in its compiled form.
+ * Groups are immutable arrays of paths replaced through RCU as well.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/config.h"
+#include "common/logging.h"
+#include "common/mem_account.h"
+#include "common/rcu.h"
+#include "common/threading.h"
+#include "hal/port_types.h"
+#include "hal/port.h"
+#include "hal/packet_drop.h"
+#include "hal/policer.h"
+#include "hal/int_telemetry.h"
+#include "l3/acl.h"
+
+#define ACL_MAX_THREADS (CONFIG_MAX_WORKER_THREADS + 4)
+#define ACL_NO_MATCH UINT32_MAX
+#define ACL_KEY_WORDS 11
+#define ACL_KEY_L4 0x01                 /* Key flag: the packet carries TCP or UDP ports */
+#define ACL_PORT_ANY(min, max) ((min) == 0 && (max) == 0xFFFF)
+#define ACL_IPV4_FRAG_OFFSET 0x1FFF     /* Fragment offset bits of flags_fragment */
+
+/**
+ * @brief Packet key; IPv4 addresses use the first four bytes of src and dst
+ */
+typedef union {
+    struct {
+        uint8_t src[sizeof(ipv6_addr_t)];
+        uint8_t dst[sizeof(ipv6_addr_t)];
+        uint16_t src_port;
+        uint16_t dst_port;
+        uint16_t in_port;
+        uint16_t vlan;
+        uint8_t protocol;
+        uint8_t version;
+        uint8_t flags;                  /* ACL_KEY_* */
+        uint8_t pad;
+    } f;
+    uint32_t w[ACL_KEY_WORDS];
+} acl_key_t;
+
+/**
+ * @brief Compiled rule, indexed by precedence
+ */
+typedef struct {
+    uint16_t src_port_min;
+    uint16_t src_port_max;
+    uint16_t dst_port_min;
+    uint16_t dst_port_max;
+    uint32_t rule_id;
+    uint32_t next;                      /* Next rule with the same masked key, ACL_NO_MATCH at the end */
+    acl_action_t action;
+    uint32_t nh_group;                  /* PBR next-hop group of ACL_ACTION_REDIRECT */
+    uint32_t policer_id;                /* Policer of permitted matches, POLICER_NONE if none */
+    bool int_watch;                     /* Permitted matches get in-band telemetry */
+} acl_crule_t;
+
+/**
+ * @brief Distinct masked key of a tuple
+ */
+typedef struct {
+    acl_key_t key;
+    uint32_t first;                     /* Best rule carrying the key */
+} acl_entry_t;
+
+/**
+ * @brief Rules sharing one mask
+ */
+typedef struct {
+    acl_key_t mask;
+    uint32_t best;                      /* Best rule of the tuple */
+    uint32_t entry_count;
+    uint32_t slot_mask;                 /* Hash slots - 1 */
+    uint32_t *slots;                    /* Entry index + 1, 0 if empty */
+    acl_entry_t *entries;
+} acl_tuple_t;
+
+/**
+ * @brief Compiled rule set, immutable once published
+ */
+typedef struct {
+    uint32_t rule_count;
+    uint32_t tuple_count;
+    acl_action_t default_action;
+    acl_crule_t *rules;
+    acl_tuple_t *tuples;                /* In order of their best rule */
+    rcu_head_t rcu;
+} acl_classifier_t;
+
+/**
+ * @brief Counters of one forwarding thread, written only by it
+ */
+typedef struct __attribute__((aligned(64))) {
+    uint64_t hits[ACL_MAX_RULES];       /* By rule ID */
+    uint64_t permitted;
+    uint64_t denied;
+    uint64_t default_hits;
+    uint64_t pbr_redirected;
+    uint64_t pbr_fallbacks;
+} acl_counters_t;
+
+/**
+ * @brief PBR next-hop group, immutable once published
+ */
+typedef struct {
+    uint32_t path_count;
+    ip_addr_type_t type;                /* Family of every path */
+    acl_pbr_path_t paths[ACL_PBR_MAX_PATHS];
+    rcu_head_t rcu;
+} acl_pbr_group_t;
+
+/**
+ * @brief ACL module state
+ */
+static struct {
+    bool initialized;
+    spinlock_t lock;                    /**< Serializes rule set swaps and counter registration */
+    acl_classifier_t *active;           /**< Published classifier, read under RCU */
+    uint32_t handle;                    /**< Pipeline processor handle */
+    acl_counters_t *counters[ACL_MAX_THREADS];
+    uint32_t counter_count;
+    uint32_t epoch;                     /**< Bumped on cleanup to orphan thread counters */
+    acl_classifier_t *pbr[ACL_PBR_MAX_POLICIES];    /**< PBR policies, NULL if empty */
+    acl_pbr_group_t *groups[ACL_PBR_MAX_GROUPS];    /**< PBR next-hop groups by number - 1 */
+    uint32_t pbr_generation;            /**< Bumped by every PBR change */
+} g_acl = {0};
+
+uint8_t g_acl_pbr_port_policy[CONFIG_MAX_PORTS];
+
+static __thread acl_counters_t *t_acl_counters;
+static __thread uint32_t t_acl_epoch;
+
+/**
+ * @brief Hash a masked key
+ */
+static inline uint32_t acl_key_hash(const acl_key_t *key) {
+    uint32_t hash = 0;
+
+    for (uint32_t i = 0; i < ACL_KEY_WORDS; i++) {
+        hash = (hash ^ key->w[i]) * 0x9E3779B1U;
+    }
+    return hash ^ (hash >> 16);
+}
+
+/**
+ * @brief Apply a tuple mask to a key
+ */
+static inline void acl_key_mask(const acl_key_t *key, const acl_key_t *mask, acl_key_t *out) {
+    for (uint32_t i = 0; i < ACL_KEY_WORDS; i++) {
+        out->w[i] = key->w[i] & mask->w[i];
+    }
+}
+
+/**
+ * @brief Mask of a prefix over the first bytes of an address
+ */
+static void acl_prefix_mask(uint8_t *mask, uint8_t prefix_len) {
+    for (uint32_t i = 0; i < sizeof(ipv6_addr_t); i++) {
+        if (prefix_len >= 8) {
+            mask[i] = 0xFF;
+            prefix_len -= 8;
+        } else {
+            mask[i] = (uint8_t)(0xFF00 >> prefix_len);
+            prefix_len = 0;
+        }
+    }
+}
+
+/**
+ * @brief Check a rule before it is compiled
+ *
+ * @param rule Rule
+ * @param pbr Whether the rule belongs to a PBR policy
+ * @return true if the rule is well formed
+ */
+static bool acl_rule_valid(const acl_rule_t *rule, bool pbr) {
+    uint8_t max_len;
+
+    if (rule->rule_id >= ACL_MAX_RULES || rule->src_addr.type != rule->dst_addr.type ||
+        (rule->src_addr.type != IP_TYPE_V4 && rule->src_addr.type != IP_TYPE_V6)) {
+        return false;
+    }
+
+    max_len = rule->src_addr.type == IP_TYPE_V4 ? 32 : 128;
+    return rule->src_prefix_len <= max_len && rule->dst_prefix_len <= max_len &&
+           rule->src_port_min <= rule->src_port_max && rule->dst_port_min <= rule->dst_port_max &&
+           rule->vlan_id <= 4094 &&
+           (pbr ? rule->policer_id == POLICER_NONE : rule->policer_id <= CONFIG_MAX_POLICERS) &&
+           (!rule->int_watch || (!pbr && rule->action == ACL_ACTION_PERMIT)) &&
+           (rule->action == ACL_ACTION_PERMIT ||
+            (!pbr && rule->action == ACL_ACTION_DENY) ||
+            (pbr && rule->action == ACL_ACTION_REDIRECT &&
+             rule->nh_group >= 1 && rule->nh_group <= ACL_PBR_MAX_GROUPS));
+}
+
+/**
+ * @brief Check every rule of a set and that their IDs are unique
+ *
+ * @param rules Rules
+ * @param count Number of rules
+ * @param pbr Whether the set is a PBR policy
+ * @return true if the set can be compiled
+ */
+static bool acl_rules_valid(const acl_rule_t *rules, uint32_t count, bool pbr) {
+    uint8_t seen[ACL_MAX_RULES / 8];
+
+    memset(seen, 0, sizeof(seen));
+    for (uint32_t i = 0; i < count; i++) {
+        if (!acl_rule_valid(&rules[i], pbr) || (seen[rules[i].rule_id / 8] & (1u << (rules[i].rule_id % 8)))) {
+            LOG_ERROR(LOG_CATEGORY_L3, "Invalid %s rule %u (ID %u)", pbr ? "PBR" : "ACL", i, rules[i].rule_id);
+            return false;
+        }
+        seen[rules[i].rule_id / 8] |= (uint8_t)(1u << (rules[i].rule_id % 8));
+    }
+    return true;
+}
+
+/**
+ * @brief Build the mask and masked key of a rule
+ *
+ * @param rule Rule
+ * @param[out] mask Tuple mask
+ * @param[out] key Rule fields under the mask
+ */
+static void acl_rule_key(const acl_rule_t *rule, acl_key_t *mask, acl_key_t *key) {
+    acl_key_t value;
+    uint32_t addr_len = rule->src_addr.type == IP_TYPE_V4 ? sizeof(ipv4_addr_t) : sizeof(ipv6_addr_t);
+    bool any_src = ACL_PORT_ANY(rule->src_port_min, rule->src_port_max);
+    bool any_dst = ACL_PORT_ANY(rule->dst_port_min, rule->dst_port_max);
+
+    memset(mask, 0, sizeof(*mask));
+    memset(&value, 0, sizeof(value));
+
+    // An IPv4 address keeps its network byte order in the first four bytes
+    memcpy(value.f.src, &rule->src_addr.addr, addr_len);
+    memcpy(value.f.dst, &rule->dst_addr.addr, addr_len);
+    acl_prefix_mask(mask->f.src, rule->src_prefix_len);
+    acl_prefix_mask(mask->f.dst, rule->dst_prefix_len);
+
+    value.f.version = rule->src_addr.type == IP_TYPE_V4 ? 4 : 6;
+    mask->f.version = 0xFF;
+
+    if (rule->match_protocol) {
+        value.f.protocol = rule->protocol;
+        mask->f.protocol = 0xFF;
+    }
+
+    // Any port criterion needs ports; single ports are part of the key
+    if (!any_src || !any_dst) {
+        value.f.flags = ACL_KEY_L4;
+        mask->f.flags = ACL_KEY_L4;
+    }
+    if (!any_src && rule->src_port_min == rule->src_port_max) {
+        value.f.src_port = htons(rule->src_port_min);
+        mask->f.src_port = 0xFFFF;
+    }
+    if (!any_dst && rule->dst_port_min == rule->dst_port_max) {
+        value.f.dst_port = htons(rule->dst_port_min);
+        mask->f.dst_port = 0xFFFF;
+    }
+
+    if (rule->in_port != PORT_ID_INVALID) {
+        value.f.in_port = rule->in_port;
+        mask->f.in_port = 0xFFFF;
+    }
+    if (rule->vlan_id != 0) {
+        value.f.vlan = rule->vlan_id;
+        mask->f.vlan = 0xFFFF;
+    }
+
+    acl_key_mask(&value, mask, key);
+}
+
+/**
+ * @brief Free a classifier
+ *
+ * @param cls Classifier, may be partly built
+ */
+static void acl_classifier_free(acl_classifier_t *cls) {
+    if (!cls) {
+        return;
+    }
+    for (uint32_t t = 0; cls->tuples && t < cls->tuple_count; t++) {
+        mem_free(MEM_TAG_ACL, cls->tuples[t].slots);
+        mem_free(MEM_TAG_ACL, cls->tuples[t].entries);
+    }
+    mem_free(MEM_TAG_ACL, cls->tuples);
+    mem_free(MEM_TAG_ACL, cls->rules);
+    mem_free(MEM_TAG_ACL, cls);
+}
+
+/**
+ * @brief Free a replaced classifier after its grace period
+ *
+ * @param head RCU header of the classifier
+ */
+static void acl_classifier_reclaim(rcu_head_t *head) {
+    acl_classifier_free((acl_classifier_t *)((char *)head - offsetof(acl_classifier_t, rcu)));
+}
+
+/**
+ * @brief Add a compiled rule to its tuple
+ *
+ * Rules are added in precedence order, so a rule sharing a masked key
+ * goes to the end of that key's chain.
+ *
+ * @param cls Classifier being built
+ * @param tuple Tuple of the rule
+ * @param key Masked key of the rule
+ * @param index Precedence of the rule
+ */
+static void acl_tuple_insert(acl_classifier_t *cls, acl_tuple_t *tuple, const acl_key_t *key, uint32_t index) {
+    uint32_t pos = acl_key_hash(key) & tuple->slot_mask;
+    acl_entry_t *entry;
+    uint32_t last;
+
+    while (tuple->slots[pos] != 0) {
+        entry = &tuple->entries[tuple->slots[pos] - 1];
+        if (memcmp(&entry->key, key, sizeof(*key)) == 0) {
+            for (last = entry->first; cls->rules[last].next != ACL_NO_MATCH; last = cls->rules[last].next) {
+            }
+            cls->rules[last].next = index;
+            return;
+        }
+        pos = (pos + 1) & tuple->slot_mask;
+    }
+
+    entry = &tuple->entries[tuple->entry_count++];
+    entry->key = *key;
+    entry->first = index;
+    tuple->slots[pos] = tuple->entry_count;
+}
+
+/**
+ * @brief Compile a rule set
+ *
+ * @param rules Validated rules in precedence order
+ * @param count Number of rules
+ * @param default_action Action for packets matching no rule
+ * @return Classifier, NULL if out of memory
+ */
+static acl_classifier_t *acl_compile(const acl_rule_t *rules, uint32_t count, acl_action_t default_action) {
+    acl_classifier_t *cls = (acl_classifier_t *)mem_calloc(MEM_TAG_ACL, 1, sizeof(acl_classifier_t));
+    acl_key_t *keys = NULL;
+    uint32_t *tuple_of = NULL;
+    uint32_t *tuple_rules = NULL;
+    uint32_t i, t;
+
+    if (!cls) {
+        return NULL;
+    }
+    cls->default_action = default_action;
+    cls->rule_count = count;
+    if (count == 0) {
+        return cls;
+    }
+
+    cls->rules = (acl_crule_t *)mem_calloc(MEM_TAG_ACL, count, sizeof(acl_crule_t));
+    cls->tuples = (acl_tuple_t *)mem_calloc(MEM_TAG_ACL, count, sizeof(acl_tuple_t));
+    keys = (acl_key_t *)mem_malloc(MEM_TAG_ACL, count * sizeof(acl_key_t));
+    tuple_of = (uint32_t *)mem_malloc(MEM_TAG_ACL, count * sizeof(uint32_t));
+    tuple_rules = (uint32_t *)mem_calloc(MEM_TAG_ACL, count, sizeof(uint32_t));
+    if (!cls->rules || !cls->tuples || !keys || !tuple_of || !tuple_rules) {
+        goto fail;
+    }
+
+    // Group the rules by shape; a tuple's first rule is its best one
+    for (i = 0; i < count; i++) {
+        acl_key_t mask;
+
+        acl_rule_key(&rules[i], &mask, &keys[i]);
+        for (t = 0; t < cls->tuple_count; t++) {
+            if (memcmp(&cls->tuples[t].mask, &mask, sizeof(mask)) == 0) {
+                break;
+            }
+        }
+        if (t == cls->tuple_count) {
+            cls->tuples[t].mask = mask;
+            cls->tuples[t].best = i;
+            cls->tuple_count++;
+        }
+        tuple_of[i] = t;
+        tuple_rules[t]++;
+
+        cls->rules[i].src_port_min = rules[i].src_port_min;
+        cls->rules[i].src_port_max = rules[i].src_port_max;
+        cls->rules[i].dst_port_min = rules[i].dst_port_min;
+        cls->rules[i].dst_port_max = rules[i].dst_port_max;
+        cls->rules[i].rule_id = rules[i].rule_id;
+        cls->rules[i].action = rules[i].action;
+        cls->rules[i].nh_group = rules[i].nh_group;
+        cls->rules[i].policer_id = rules[i].policer_id;
+        cls->rules[i].int_watch = rules[i].int_watch;
+        cls->rules[i].next = ACL_NO_MATCH;
+    }
+
+    // Buckets at most half full keep probe sequences short
+    for (t = 0; t < cls->tuple_count; t++) {
+        acl_tuple_t *tuple = &cls->tuples[t];
+        uint32_t slots = 2;
+
+        while (slots < tuple_rules[t] * 2) {
+            slots <<= 1;
+        }
+        tuple->slot_mask = slots - 1;
+        tuple->slots = (uint32_t *)mem_calloc(MEM_TAG_ACL, slots, sizeof(uint32_t));
+        tuple->entries = (acl_entry_t *)mem_malloc(MEM_TAG_ACL, tuple_rules[t] * sizeof(acl_entry_t));
+        if (!tuple->slots || !tuple->entries) {
+            goto fail;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        acl_tuple_insert(cls, &cls->tuples[tuple_of[i]], &keys[i], i);
+    }
+
+    mem_free(MEM_TAG_ACL, keys);
+    mem_free(MEM_TAG_ACL, tuple_of);
+    mem_free(MEM_TAG_ACL, tuple_rules);
+    return cls;
+
+fail:
+    mem_free(MEM_TAG_ACL, keys);
+    mem_free(MEM_TAG_ACL, tuple_of);
+    mem_free(MEM_TAG_ACL, tuple_rules);
+    acl_classifier_free(cls);
+    return NULL;
+}
+
+/**
+ * @brief Build the key of a packet from its header cache
+ *
+ * @param packet Frame, parsed down to L3
+ * @param[out] key Packet key
+ * @return true for IPv4 and IPv6 packets
+ */
+static bool acl_key_from_cache(const packet_buffer_t *packet, acl_key_t *key) {
+    const uint8_t *l3;
+    uint16_t l4_offset;
+
+    memset(key, 0, sizeof(*key));
+    l3 = packet->data + packet_l3_offset(packet);
+    // The L3 header sits 14 bytes into the frame, so its fields are copied out by offset
+    if (packet_has_proto(packet, PACKET_PROTO_IPV4)) {
+        memcpy(key->f.src, l3 + offsetof(ipv4_header_t, src_addr), sizeof(ipv4_addr_t));
+        memcpy(key->f.dst, l3 + offsetof(ipv4_header_t, dst_addr), sizeof(ipv4_addr_t));
+        key->f.version = 4;
+    } else if (packet_has_proto(packet, PACKET_PROTO_IPV6)) {
+        memcpy(key->f.src, l3 + offsetof(ipv6_header_t, src_addr), sizeof(ipv6_addr_t));
+        memcpy(key->f.dst, l3 + offsetof(ipv6_header_t, dst_addr), sizeof(ipv6_addr_t));
+        key->f.version = 6;
+    } else {
+        return false;
+    }
+    key->f.protocol = packet->metadata.l4_proto;
+
+    // Non-first fragments have no transport header and match no port rule
+    l4_offset = packet_l4_offset(packet);
+    if (packet_parsed_has(packet, PACKET_PARSED_L4) &&
+        packet_has_proto(packet, PACKET_PROTO_TCP | PACKET_PROTO_UDP) &&
+        (uint32_t)l4_offset + 2 * sizeof(uint16_t) <= packet->size) {
+        memcpy(&key->f.src_port, packet->data + l4_offset, sizeof(uint16_t));
+        memcpy(&key->f.dst_port, packet->data + l4_offset + sizeof(uint16_t), sizeof(uint16_t));
+        key->f.flags = ACL_KEY_L4;
+    }
+
+    key->f.in_port = packet->metadata.port;
+    key->f.vlan = packet->metadata.vlan;
+    return true;
+}
+
+/**
+ * @brief Build the key of a packet
+ *
+ * @param packet Frame
+ * @param[out] key Packet key
+ * @return true for IPv4 and IPv6 packets
+ */
+static bool acl_key_build(packet_buffer_t *packet, acl_key_t *key) {
+    if (packet_ensure_parsed(packet) != STATUS_SUCCESS || !packet_parsed_has(packet, PACKET_PARSED_L3)) {
+        return false;
+    }
+    return acl_key_from_cache(packet, key);
+}
+
+/**
+ * @brief Build the key of an IP packet from the header at an offset
+ *
+ * Used where the header cache does not describe the packet, e.g. once
+ * the L2 header is gone. Ports are read behind an IPv4 header that is not
+ * a non-first fragment and behind an IPv6 header directly followed by
+ * TCP or UDP.
+ *
+ * @param packet Packet
+ * @param l3_offset Offset of the IP header
+ * @param[out] key Packet key
+ * @return true for IPv4 and IPv6 packets long enough for their header
+ */
+static bool acl_key_from_header(const packet_buffer_t *packet, uint16_t l3_offset, acl_key_t *key) {
+    const uint8_t *l3 = packet->data + l3_offset;
+    uint32_t l4_offset;
+
+    if ((uint32_t)l3_offset + 1 > packet->size) {
+        return false;
+    }
+
+    memset(key, 0, sizeof(*key));
+    if ((l3[0] >> 4) == 4) {
+        const ipv4_header_t *header = (const ipv4_header_t *)l3;
+
+        if ((uint32_t)l3_offset + sizeof(ipv4_header_t) > packet->size) {
+            return false;
+        }
+        memcpy(key->f.src, &header->src_addr, sizeof(ipv4_addr_t));
+        memcpy(key->f.dst, &header->dst_addr, sizeof(ipv4_addr_t));
+        key->f.version = 4;
+        key->f.protocol = header->protocol;
+        l4_offset = (ntohs(header->flags_fragment) & ACL_IPV4_FRAG_OFFSET) ? UINT32_MAX :
+                    (uint32_t)l3_offset + (header->version_ihl & 0x0F) * 4;
+    } else if ((l3[0] >> 4) == 6) {
+        const ipv6_header_t *header = (const ipv6_header_t *)l3;
+
+        if ((uint32_t)l3_offset + sizeof(ipv6_header_t) > packet->size) {
+            return false;
+        }
+        memcpy(key->f.src, &header->src_addr, sizeof(ipv6_addr_t));
+        memcpy(key->f.dst, &header->dst_addr, sizeof(ipv6_addr_t));
+        key->f.version = 6;
+        key->f.protocol = header->next_header;
+        l4_offset = (uint32_t)l3_offset + sizeof(ipv6_header_t);
+    } else {
+        return false;
+    }
+
+    if ((key->f.protocol == IP_PROTO_TCP || key->f.protocol == IP_PROTO_UDP) &&
+        l4_offset != UINT32_MAX && l4_offset + 2 * sizeof(uint16_t) <= packet->size) {
+        memcpy(&key->f.src_port, packet->data + l4_offset, sizeof(uint16_t));
+        memcpy(&key->f.dst_port, packet->data + l4_offset + sizeof(uint16_t), sizeof(uint16_t));
+        key->f.flags = ACL_KEY_L4;
+    }
+
+    key->f.in_port = packet->metadata.port;
+    key->f.vlan = packet->metadata.vlan;
+    return true;
+}
+
+/**
+ * @brief Find the best rule of a tuple matching a key
+ *
+ * @param cls Classifier
+ * @param tuple Tuple to probe
+ * @param key Packet key
+ * @param best Best match so far
+ * @return Better matching rule, or best if there is none
+ */
+static inline uint32_t acl_tuple_lookup(const acl_classifier_t *cls, const acl_tuple_t *tuple,
+                                        const acl_key_t *key, uint32_t best) {
+    acl_key_t masked;
+    uint32_t pos;
+
+    acl_key_mask(key, &tuple->mask, &masked);
+    pos = acl_key_hash(&masked) & tuple->slot_mask;
+
+    while (tuple->slots[pos] != 0) {
+        const acl_entry_t *entry = &tuple->entries[tuple->slots[pos] - 1];
+
+        if (memcmp(&entry->key, &masked, sizeof(masked)) == 0) {
+            uint16_t src_port = ntohs(key->f.src_port);
+            uint16_t dst_port = ntohs(key->f.dst_port);
+
+            // Ranges were left out of the mask; the chain is in precedence order
+            for (uint32_t r = entry->first; r < best; r = cls->rules[r].next) {
+                const acl_crule_t *rule = &cls->rules[r];
+                if (src_port >= rule->src_port_min && src_port <= rule->src_port_max &&
+                    dst_port >= rule->dst_port_min && dst_port <= rule->dst_port_max) {
+                    return r;
+                }
+            }
+            return best;
+        }
+        pos = (pos + 1) & tuple->slot_mask;
+    }
+
+    return best;
+}
+
+/**
+ * @brief Find the best rule matching each of a set of keys
+ *
+ * @param cls Classifier
+ * @param keys Packet keys
+ * @param n Number of keys
+ * @param[out] match Best matching rule of each key, ACL_NO_MATCH if none
+ */
+static void acl_classify_keys(const acl_classifier_t *cls, const acl_key_t *keys, uint32_t n, uint32_t *match) {
+    for (uint32_t j = 0; j < n; j++) {
+        match[j] = ACL_NO_MATCH;
+    }
+
+    // Tuple by tuple, probing only with packets the tuple could still improve
+    for (uint32_t t = 0; t < cls->tuple_count; t++) {
+        const acl_tuple_t *tuple = &cls->tuples[t];
+        bool open = false;
+
+        for (uint32_t j = 0; j < n; j++) {
+            if (match[j] > tuple->best) {
+                open = true;
+                match[j] = acl_tuple_lookup(cls, tuple, &keys[j], match[j]);
+            }
+        }
+        if (!open) {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Get the calling thread's counters, creating them on first use
+ *
+ * @return Counters, NULL if none could be created
+ */
+static acl_counters_t *acl_counters_get(void) {
+    uint32_t epoch = __atomic_load_n(&g_acl.epoch, __ATOMIC_ACQUIRE);
+    acl_counters_t *counters = NULL;
+
+    if (t_acl_counters && t_acl_epoch == epoch) {
+        return t_acl_counters;
+    }
+
+    if ((counters = mem_aligned_alloc(MEM_TAG_ACL, 64, sizeof(acl_counters_t))) == NULL) {
+        return NULL;
+    }
+    memset(counters, 0, sizeof(*counters));
+
+    spinlock_acquire(&g_acl.lock);
+    if (g_acl.counter_count >= ACL_MAX_THREADS) {
+        spinlock_release(&g_acl.lock);
+        mem_free(MEM_TAG_ACL, counters);
+        LOG_WARNING(LOG_CATEGORY_L3, "No ACL counters left for this thread");
+        return NULL;
+    }
+    g_acl.counters[g_acl.counter_count] = counters;
+    // Publish the block after it is set up
+    __atomic_store_n(&g_acl.counter_count, g_acl.counter_count + 1, __ATOMIC_RELEASE);
+    spinlock_release(&g_acl.lock);
+
+    t_acl_counters = counters;
+    t_acl_epoch = epoch;
+    return counters;
+}
+
+/**
+ * @brief Count one verdict on the calling thread
+ */
+static inline void acl_count(uint64_t *counter) {
+    __atomic_store_n(counter, *counter + 1, __ATOMIC_RELAXED);
+}
+
+static status_t acl_classify(packet_buffer_t **pkts, uint32_t count, acl_action_t *actions,
+                             uint32_t *policers, bool *watch);
+
+/**
+ * @brief ACL stage of the packet pipeline
+ *
+ * Permitted packets are charged to the policer of the rule they matched,
+ * and chosen for in-band telemetry if the rule asks for it.
+ */
+static void acl_process_burst(packet_buffer_t **pkts, uint32_t count, packet_result_t *results, void *user_data) {
+    acl_action_t actions[PACKET_BURST_MAX];
+    uint32_t policers[PACKET_BURST_MAX];
+    bool watch[PACKET_BURST_MAX];
+    bool stamp = int_telemetry_enabled();
+
+    (void)user_data;
+    if (acl_classify(pkts, count, actions, policers, stamp ? watch : NULL) != STATUS_SUCCESS) {
+        for (uint32_t i = 0; i < count; i++) {
+            results[i] = PACKET_RESULT_FORWARD;
+        }
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (actions[i] == ACL_ACTION_DENY) {
+            packet_drop_count(pkts[i], PACKET_DROP_ACL_DENY);
+            results[i] = PACKET_RESULT_DROP;
+        } else if (policers[i] != POLICER_NONE && !policer_police(policers[i], pkts[i])) {
+            results[i] = PACKET_RESULT_DROP;
+        } else {
+            results[i] = PACKET_RESULT_FORWARD;
+#if CONFIG_ENABLE_INT
+            // Packets that arrived with a shim are stamped anyway
+            if (stamp && watch[i] && pkts[i]->metadata.int_watch == INT_WATCH_NONE) {
+                pkts[i]->metadata.int_watch = INT_WATCH_SOURCE;
+            }
+#endif
+        }
+    }
+}
+
+/**
+ * @brief Initialize the ACL and register its pipeline stage
+ *
+ * @return status_t Status code
+ */
+status_t acl_init(void) {
+    status_t status;
+
+    if (g_acl.initialized) {
+        return STATUS_SUCCESS;
+    }
+
+    spinlock_init(&g_acl.lock);
+    g_acl.active = acl_compile(NULL, 0, ACL_ACTION_PERMIT);
+    if (!g_acl.active) {
+        return STATUS_NO_MEMORY;
+    }
+
+    status = packet_register_burst_processor(acl_process_burst, ACL_PROCESSOR_PRIORITY, NULL, &g_acl.handle);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to register the ACL stage: %d", status);
+        acl_classifier_free(g_acl.active);
+        g_acl.active = NULL;
+        return status;
+    }
+    packet_set_processor_name(g_acl.handle, "acl");
+
+    g_acl.initialized = true;
+    LOG_INFO(LOG_CATEGORY_L3, "ACL initialized");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Unregister the ACL stage and free its state
+ *
+ * @return status_t Status code
+ */
+status_t acl_cleanup(void) {
+    if (!g_acl.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    packet_unregister_processor(g_acl.handle);
+    rcu_synchronize();
+
+    acl_classifier_free(g_acl.active);
+    g_acl.active = NULL;
+    memset(g_acl_pbr_port_policy, 0, sizeof(g_acl_pbr_port_policy));
+    for (uint32_t i = 0; i < ACL_PBR_MAX_POLICIES; i++) {
+        acl_classifier_free(g_acl.pbr[i]);
+        g_acl.pbr[i] = NULL;
+    }
+    for (uint32_t i = 0; i < ACL_PBR_MAX_GROUPS; i++) {
+        mem_free(MEM_TAG_ACL, g_acl.groups[i]);
+        g_acl.groups[i] = NULL;
+    }
+    g_acl.pbr_generation++;
+    for (uint32_t i = 0; i < g_acl.counter_count; i++) {
+        mem_free(MEM_TAG_ACL, g_acl.counters[i]);
+        g_acl.counters[i] = NULL;
+    }
+    g_acl.counter_count = 0;
+    __atomic_store_n(&g_acl.epoch, g_acl.epoch + 1, __ATOMIC_RELEASE);
+
+    g_acl.initialized = false;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Validate and compile a rule set, then swap it in
+ *
+ * The old classifier is retired once no burst can still be using it.
+ *
+ * @param rules Rules in precedence order
+ * @param count Number of rules
+ * @param default_action Action for packets matching no rule
+ * @return status_t Status code
+ */
+status_t acl_set_rules(const acl_rule_t *rules, uint32_t count, acl_action_t default_action) {
+    acl_classifier_t *cls;
+    acl_classifier_t *old;
+
+    if (!g_acl.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if ((count > 0 && !rules) || count > ACL_MAX_RULES ||
+        (default_action != ACL_ACTION_PERMIT && default_action != ACL_ACTION_DENY)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (!acl_rules_valid(rules, count, false)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    cls = acl_compile(rules, count, default_action);
+    if (!cls) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to compile ACL rule set of %u rules", count);
+        return STATUS_NO_MEMORY;
+    }
+
+    spinlock_acquire(&g_acl.lock);
+    old = __atomic_exchange_n(&g_acl.active, cls, __ATOMIC_ACQ_REL);
+    spinlock_release(&g_acl.lock);
+    if (old) {
+        rcu_retire(&old->rcu, acl_classifier_reclaim);
+    }
+
+    LOG_INFO(LOG_CATEGORY_L3, "ACL rule set of %u rules compiled into %u tuples", count, cls->tuple_count);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Classify a burst against the active classifier
+ *
+ * @param pkts Packets
+ * @param count Number of packets
+ * @param[out] actions Action for each packet
+ * @param[out] policers Policer of each packet's rule, NULL if not wanted
+ * @param[out] watch Whether each packet's rule asks for in-band telemetry, NULL if not wanted
+ * @return status_t Status code
+ */
+static status_t acl_classify(packet_buffer_t **pkts, uint32_t count, acl_action_t *actions,
+                             uint32_t *policers, bool *watch) {
+    acl_key_t keys[PACKET_BURST_MAX];
+    uint32_t index[PACKET_BURST_MAX];
+    uint32_t match[PACKET_BURST_MAX];
+    const acl_classifier_t *cls;
+    acl_counters_t *counters;
+    uint32_t n = 0;
+
+    if (!g_acl.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!pkts || !actions || count > PACKET_BURST_MAX) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        actions[i] = ACL_ACTION_PERMIT;
+        if (policers) {
+            policers[i] = POLICER_NONE;
+        }
+        if (watch) {
+            watch[i] = false;
+        }
+        if (pkts[i] && acl_key_build(pkts[i], &keys[n])) {
+            index[n] = i;
+            n++;
+        }
+    }
+    if (n == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    if (rcu_read_lock() != STATUS_SUCCESS) {
+        return STATUS_NO_MEMORY;
+    }
+    cls = __atomic_load_n(&g_acl.active, __ATOMIC_ACQUIRE);
+    acl_classify_keys(cls, keys, n, match);
+
+    counters = acl_counters_get();
+    for (uint32_t j = 0; j < n; j++) {
+        acl_action_t action;
+
+        if (match[j] == ACL_NO_MATCH) {
+            action = cls->default_action;
+            if (counters) {
+                acl_count(&counters->default_hits);
+            }
+        } else {
+            action = cls->rules[match[j]].action;
+            if (counters) {
+                acl_count(&counters->hits[cls->rules[match[j]].rule_id]);
+            }
+            if (policers) {
+                policers[index[j]] = cls->rules[match[j]].policer_id;
+            }
+            if (watch) {
+                watch[index[j]] = cls->rules[match[j]].int_watch;
+            }
+        }
+        if (counters) {
+            acl_count(action == ACL_ACTION_DENY ? &counters->denied : &counters->permitted);
+        }
+        actions[index[j]] = action;
+    }
+
+    rcu_read_unlock();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Classify a burst against the active classifier
+ *
+ * @param pkts Packets
+ * @param count Number of packets
+ * @param[out] actions Action for each packet
+ * @return status_t Status code
+ */
+status_t acl_classify_burst(packet_buffer_t **pkts, uint32_t count, acl_action_t *actions) {
+    return acl_classify(pkts, count, actions, NULL, NULL);
+}
+
+/**
+ * @brief Sum the hits of a rule over all thread counters
+ *
+ * @param rule_id Rule ID
+ * @param[out] hits Hits
+ * @return status_t Status code
+ */
+status_t acl_get_rule_hits(uint32_t rule_id, uint64_t *hits) {
+    uint32_t count;
+
+    if (!g_acl.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (rule_id >= ACL_MAX_RULES || !hits) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    *hits = 0;
+    count = __atomic_load_n(&g_acl.counter_count, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < count; i++) {
+        *hits += __atomic_load_n(&g_acl.counters[i]->hits[rule_id], __ATOMIC_RELAXED);
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Sum the verdict counters and describe the active classifier
+ *
+ * @param[out] stats Counters
+ * @return status_t Status code
+ */
+status_t acl_get_stats(acl_stats_t *stats) {
+    const acl_classifier_t *cls;
+    uint32_t count;
+
+    if (!g_acl.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    count = __atomic_load_n(&g_acl.counter_count, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < count; i++) {
+        const acl_counters_t *counters = g_acl.counters[i];
+        stats->permitted += __atomic_load_n(&counters->permitted, __ATOMIC_RELAXED);
+        stats->denied += __atomic_load_n(&counters->denied, __ATOMIC_RELAXED);
+        stats->default_hits += __atomic_load_n(&counters->default_hits, __ATOMIC_RELAXED);
+        stats->pbr_redirected += __atomic_load_n(&counters->pbr_redirected, __ATOMIC_RELAXED);
+        stats->pbr_fallbacks += __atomic_load_n(&counters->pbr_fallbacks, __ATOMIC_RELAXED);
+    }
+
+    // The writer lock keeps the classifier from being retired while it is read
+    spinlock_acquire(&g_acl.lock);
+    cls = g_acl.active;
+    stats->rule_count = cls->rule_count;
+    stats->tuple_count = cls->tuple_count;
+    spinlock_release(&g_acl.lock);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Free a replaced PBR next-hop group after its grace period
+ *
+ * @param head RCU header of the group
+ */
+static void acl_pbr_group_reclaim(rcu_head_t *head) {
+    mem_free(MEM_TAG_ACL, (char *)head - offsetof(acl_pbr_group_t, rcu));
+}
+
+/**
+ * @brief Bump the PBR generation after a change is published
+ */
+static inline void acl_pbr_changed(void) {
+    __atomic_add_fetch(&g_acl.pbr_generation, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Validate the paths of a group and swap them in
+ *
+ * @param group Group number
+ * @param paths Paths
+ * @param count Number of paths, 0 to delete the group
+ * @return status_t Status code
+ */
+status_t acl_pbr_set_group(uint32_t group, const acl_pbr_path_t *paths, uint32_t count) {
+    acl_pbr_group_t *entry = NULL;
+    acl_pbr_group_t *old;
+
+    if (!g_acl.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (group < 1 || group > ACL_PBR_MAX_GROUPS || count > ACL_PBR_MAX_PATHS || (count > 0 && !paths)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if ((paths[i].next_hop.type != IP_TYPE_V4 && paths[i].next_hop.type != IP_TYPE_V6) ||
+            paths[i].next_hop.type != paths[0].next_hop.type || paths[i].egress_port >= CONFIG_MAX_PORTS) {
+            return STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    if (count > 0) {
+        entry = (acl_pbr_group_t *)mem_calloc(MEM_TAG_ACL, 1, sizeof(acl_pbr_group_t));
+        if (!entry) {
+            return STATUS_NO_MEMORY;
+        }
+        entry->path_count = count;
+        entry->type = paths[0].next_hop.type;
+        memcpy(entry->paths, paths, count * sizeof(acl_pbr_path_t));
+    }
+
+    spinlock_acquire(&g_acl.lock);
+    old = __atomic_exchange_n(&g_acl.groups[group - 1], entry, __ATOMIC_ACQ_REL);
+    spinlock_release(&g_acl.lock);
+    if (old) {
+        rcu_retire(&old->rcu, acl_pbr_group_reclaim);
+    }
+    acl_pbr_changed();
+
+    LOG_INFO(LOG_CATEGORY_L3, "PBR next-hop group %u set to %u paths", group, count);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Validate and compile a PBR policy, then swap it in
+ *
+ * @param policy_id Policy
+ * @param rules Rules in precedence order
+ * @param count Number of rules, 0 to empty the policy
+ * @return status_t Status code
+ */
+status_t acl_pbr_set_policy(uint32_t policy_id, const acl_rule_t *rules, uint32_t count) {
+    acl_classifier_t *cls = NULL;
+    acl_classifier_t *old;
+
+    if (!g_acl.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (policy_id >= ACL_PBR_MAX_POLICIES || (count > 0 && !rules) || count > ACL_MAX_RULES ||
+        !acl_rules_valid(rules, count, true)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // An empty policy routes everything by the FIB and needs no classifier
+    if (count > 0) {
+        cls = acl_compile(rules, count, ACL_ACTION_PERMIT);
+        if (!cls) {
+            LOG_ERROR(LOG_CATEGORY_L3, "Failed to compile PBR policy %u of %u rules", policy_id, count);
+            return STATUS_NO_MEMORY;
+        }
+    }
+
+    spinlock_acquire(&g_acl.lock);
+    old = __atomic_exchange_n(&g_acl.pbr[policy_id], cls, __ATOMIC_ACQ_REL);
+    spinlock_release(&g_acl.lock);
+    if (old) {
+        rcu_retire(&old->rcu, acl_classifier_reclaim);
+    }
+    acl_pbr_changed();
+
+    LOG_INFO(LOG_CATEGORY_L3, "PBR policy %u of %u rules compiled into %u tuples",
+             policy_id, count, cls ? cls->tuple_count : 0);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Attach a PBR policy to an ingress port
+ *
+ * @param port Ingress port
+ * @param policy_id Policy or ACL_PBR_NONE
+ * @return status_t Status code
+ */
+status_t acl_pbr_attach(port_id_t port, uint32_t policy_id) {
+    if (!g_acl.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (port >= CONFIG_MAX_PORTS || (policy_id >= ACL_PBR_MAX_POLICIES && policy_id != ACL_PBR_NONE)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    __atomic_store_n(&g_acl_pbr_port_policy[port],
+                     (uint8_t)(policy_id == ACL_PBR_NONE ? 0 : policy_id + 1), __ATOMIC_RELAXED);
+    acl_pbr_changed();
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Classify a packet against its port's policy and pick a path
+ *
+ * @param packet Packet
+ * @param l3_offset Offset of the IP header
+ * @param[out] next_hop Next hop
+ * @param[out] egress_port Egress port
+ * @return status_t Status code
+ */
+status_t acl_pbr_lookup(const packet_buffer_t *packet, uint16_t l3_offset, ip_addr_t *next_hop,
+                        port_id_t *egress_port) {
+    const acl_classifier_t *cls;
+    const acl_pbr_group_t *group;
+    acl_counters_t *counters;
+    acl_key_t key;
+    uint32_t match;
+    uint32_t policy;
+    bool built;
+    status_t status = STATUS_NOT_FOUND;
+
+    if (!g_acl.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!packet || !next_hop || !egress_port) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    policy = acl_pbr_attached(packet->metadata.port) ?
+             __atomic_load_n(&g_acl_pbr_port_policy[packet->metadata.port], __ATOMIC_RELAXED) : 0;
+    if (policy == 0) {
+        return STATUS_NOT_FOUND;
+    }
+
+    if (packet_parsed_has(packet, PACKET_PARSED_L3) && packet_l3_offset(packet) == l3_offset) {
+        built = acl_key_from_cache(packet, &key);
+    } else {
+        built = acl_key_from_header(packet, l3_offset, &key);
+    }
+    if (!built) {
+        return STATUS_NOT_FOUND;
+    }
+
+    if (rcu_read_lock() != STATUS_SUCCESS) {
+        return STATUS_NO_MEMORY;
+    }
+    cls = __atomic_load_n(&g_acl.pbr[policy - 1], __ATOMIC_ACQUIRE);
+    if (!cls) {
+        rcu_read_unlock();
+        return STATUS_NOT_FOUND;
+    }
+
+    acl_classify_keys(cls, &key, 1, &match);
+    if (match == ACL_NO_MATCH || cls->rules[match].action != ACL_ACTION_REDIRECT) {
+        rcu_read_unlock();
+        return STATUS_NOT_FOUND;
+    }
+
+    // A flow keeps its path; a path that is down passes it to the next one
+    group = __atomic_load_n(&g_acl.groups[cls->rules[match].nh_group - 1], __ATOMIC_ACQUIRE);
+    if (group && group->type == (key.f.version == 4 ? IP_TYPE_V4 : IP_TYPE_V6)) {
+        uint32_t first = acl_key_hash(&key) % group->path_count;
+
+        for (uint32_t i = 0; i < group->path_count; i++) {
+            const acl_pbr_path_t *path = &group->paths[(first + i) % group->path_count];
+
+            if (port_is_up(path->egress_port)) {
+                *next_hop = path->next_hop;
+                *egress_port = path->egress_port;
+                status = STATUS_SUCCESS;
+                break;
+            }
+        }
+    }
+    rcu_read_unlock();
+
+    // No usable path: the FIB routes the packet as if no rule had matched
+    counters = acl_counters_get();
+    if (counters) {
+        acl_count(status == STATUS_SUCCESS ? &counters->pbr_redirected : &counters->pbr_fallbacks);
+    }
+    return status;
+}
+
+/**
+ * @brief Current PBR generation
+ *
+ * @return Generation
+ */
+uint32_t acl_pbr_get_generation(void) {
+    return __atomic_load_n(&g_acl.pbr_generation, __ATOMIC_ACQUIRE);
+}
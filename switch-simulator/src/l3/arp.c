@@ -4,6 +4,32 @@
  *
  * This file contains the implementation of ARP table management and related operations,
  * including ARP cache maintenance, lookups, and packet processing.
+ *
+ * Forwarding threads read the cache without locks: hash chains are walked
+ * inside an RCU read section, and every resolved neighbor carries an
+ * immutable L2 rewrite string that is replaced, never modified. Writers
+ * serialize on the table lock, and removed entries return to the pool only
+ * after a grace period.
+ *
+ * A full cache doubles its entry limit up to CONFIG_ARP_GROW_MAX_ENTRIES
+ * before it starts recycling, and the buckets double with it: the new
+ * array is published next to the old one, writers move a few old chains
+ * over per insertion and per aging pass, and lookups search both arrays
+ * until the old one is empty, so no resize ever stops the table.
+ *
+ * Packets routed to a neighbor that is still being resolved wait on the
+ * neighbor, a few at a time, and leave in one burst when the reply comes.
+ *
+ * Every entry carries one state timer in a two-level timing wheel of
+ * one-second ticks. Aging advances the wheel and visits only the entries
+ * whose timer fired, which drives them through the neighbor state machine:
+ * REACHABLE goes STALE after the cache timeout, a STALE neighbor that was
+ * forwarded to is probed after a DELAY, and one that was not is removed.
+ *
+ * The IPv6 Neighbor Discovery cache is a second table on the same engine:
+ * its entries are keyed by IPv6 address, resolved with Neighbor
+ * Solicitations and confirmed by Neighbor Advertisements, and share the
+ * pool, timers, pending queues and rewrite strings of the ARP cache.
  */
 
 #include "l3/arp.h"
@@ -12,17 +38,55 @@
 #include "l2/vlan.h"
 #include "common/logging.h"
 #include "common/error_codes.h"
+#include "common/config.h"
+#include "common/keyed_hash.h"
+#include "common/mem_arena.h"
+#include "common/mem_account.h"
+#include "common/rcu.h"
+#include "common/sim_clock.h"
+#include "common/threading.h"
+#include "common/trace.h"
 #include "hal/packet.h"
 #include "hal/port.h"
+#include "hal/hw_simulation.h"
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <arpa/inet.h>
 
 /* Defines */
-#define ARP_CACHE_SIZE 1024
-#define ARP_CACHE_TIMEOUT_SEC 1200  /* 20 minutes by default */
+#define ARP_CACHE_SIZE CONFIG_MAX_ARP_ENTRIES /* Entries before the oldest is recycled, to begin with */
+#define ARP_GROW_MAX (CONFIG_ARP_GROW_MAX_ENTRIES > ARP_CACHE_SIZE ? CONFIG_ARP_GROW_MAX_ENTRIES : ARP_CACHE_SIZE)
+#define ARP_HASH_SIZE 4096          /* Hash buckets to begin with */
+#define ARP_HASH_LOAD 2             /* Entries per bucket that start a resize */
+#define ARP_RESIZE_STEP 4           /* Old buckets migrated per insertion while resizing */
+#define ARP_RESIZE_AGE_STEP 256     /* Old buckets migrated per aging pass while resizing */
+#define ARP_CACHE_TIMEOUT_SEC CONFIG_DEFAULT_ARP_AGING_TIME
 #define ARP_REQUEST_RETRY_COUNT 3
 #define ARP_REQUEST_RETRY_INTERVAL_MS 1000
+#define ARP_RETIRE_SLACK 256        /* Pool entries beyond the cache size, for entries awaiting a grace period */
+#define ARP_POOL_CHUNK 256          /* Entries added to the pool whenever it runs dry */
+#define ARP_AGE_RETRY_BATCH 32      /* Requests resent per aging pass, sent after the lock is dropped */
+#define ARP_PENDING_MAX 8           /* Packets held per neighbor while it is resolved */
+#define ARP_REQUEST_RATE_GLOBAL 1000 /* Requests per second the switch may send */
+#define ARP_REQUEST_RATE_PORT 100   /* Requests per second one port may send */
+#define ARP_REQUEST_BACKOFF_MAX 5   /* Retry interval doubles at most this many times */
+#define ARP_NS_PER_SEC 1000000000ULL
+#define ARP_NS_PER_MS 1000000ULL
+#define ARP_STALE_TIMEOUT_SEC 60    /* Stale neighbors nobody forwarded to are removed after this */
+#define ARP_DELAY_SEC 5             /* Used stale neighbors are probed after this */
+#define ARP_FAILED_HOLD_SEC 20      /* Failed resolutions are remembered this long */
+
+/* Timing wheel: level 0 has one-second slots, level 1 slots of ARP_WHEEL_L0_SLOTS seconds */
+#define ARP_WHEEL_L0_BITS 8
+#define ARP_WHEEL_L1_BITS 6
+#define ARP_WHEEL_L0_SLOTS (1U << ARP_WHEEL_L0_BITS)
+#define ARP_WHEEL_L1_SLOTS (1U << ARP_WHEEL_L1_BITS)
+#define ARP_WHEEL_SPAN (ARP_WHEEL_L0_SLOTS << ARP_WHEEL_L1_BITS)
+
+#define ARP_LOCK(table) spinlock_acquire(&(table)->lock)
+#define ARP_UNLOCK(table) spinlock_release(&(table)->lock)
 
 /* ARP packet format definitions */
 #define ARP_HARDWARE_TYPE_ETHERNET 1
@@ -34,6 +98,8 @@
 
 // В начале файла arp.c (после включения заголовочных файлов)
 static arp_table_t g_arp_table; // Глобальная переменная для ARP-таблицы
+static arp_table_t g_nd_table;  // Кэш соседей IPv6 на том же движке
+static uint32_t g_arp_generation = 1; /* Bumped whenever a rewrite of either table changes or goes away */
 
 /* ARP packet structure */
 typedef struct /* __attribute__((__packed__)) */ 
@@ -49,6 +115,26 @@ typedef struct /* __attribute__((__packed__)) */
     ipv4_addr_t target_ip;  /* Target IP address */
 } arp_packet_t;
 
+/* Neighbor Discovery message format definitions */
+#define ND_TYPE_NEIGHBOR_SOLICIT 135
+#define ND_TYPE_NEIGHBOR_ADVERT 136
+#define ND_OPT_SOURCE_LLADDR 1
+#define ND_OPT_TARGET_LLADDR 2
+#define ND_HOP_LIMIT 255            /* Only on-link senders can produce it */
+#define ND_NA_FLAG_SOLICITED 0x40000000U
+
+/* Neighbor Solicitation or Advertisement with one link-layer address option */
+typedef struct {
+    uint8_t type;             /* ND_TYPE_* */
+    uint8_t code;             /* 0 */
+    uint16_t checksum;        /* ICMPv6 checksum over the pseudo-header */
+    uint32_t flags;           /* NA router/solicited/override flags, reserved in NS */
+    ipv6_addr_t target;       /* Address being resolved */
+    uint8_t opt_type;         /* ND_OPT_*_LLADDR */
+    uint8_t opt_len;          /* Option length in units of 8 bytes */
+    mac_addr_t lladdr;        /* Link-layer address */
+} nd_message_t;
+
 /* ARP cache entry states */
 typedef enum {
     ARP_STATE_INCOMPLETE,  /* Resolution in progress */
@@ -59,26 +145,97 @@ typedef enum {
     ARP_STATE_FAILED       /* ARP resolution failed */
 } arp_state_t;
 
+/* Sender learned from one frame of a burst */
+typedef struct {
+    ipv4_addr_t ip;
+    mac_addr_t mac;
+    uint16_t port_index;
+    uint32_t bucket;          /* Hash bucket of ip */
+} arp_update_t;
+
+/* Published rewrite string, retired through RCU when replaced */
+typedef struct {
+    arp_rewrite_t rewrite;    /* What readers see */
+    rcu_head_t rcu;           /* Deferred free after replacement */
+} arp_rewrite_node_t;
+
+/* Neighbor address: IPv4 in the ARP cache, IPv6 in the ND cache */
+typedef union {
+    ipv4_addr_t v4;
+    ipv6_addr_t v6;
+} arp_addr_t;
+
 /* ARP cache entry structure */
 typedef struct arp_entry {
-    ipv4_addr_t ip;           /* IPv4 address */
+    union {
+        ipv4_addr_t ip;       /* IPv4 address */
+        ipv6_addr_t ip6;      /* IPv6 address, in the ND cache */
+        arp_addr_t addr;      /* Either, as the table's family says */
+    };
     mac_addr_t mac;           /* MAC address */
     arp_state_t state;        /* Entry state */
     uint32_t created_time;    /* Creation timestamp */
     uint32_t updated_time;    /* Last update timestamp */
     uint16_t port_index;      /* Port where this MAC was learned */
+    uint16_t vlan_id;         /* VLAN tag of the rewrite, 0 if sent untagged */
     uint8_t retry_count;      /* Retry counter for ARP requests */
+    bool used;                /* Forwarded to since it went stale */
+    uint32_t timer_deadline;  /* When the state timer fires (s) */
+    struct arp_entry *timer_next;   /* Next entry of the same wheel slot */
+    struct arp_entry **timer_pprev; /* Link pointing at the entry, NULL if no timer is armed */
+    arp_rewrite_node_t *rewrite; /* L2 rewrite while resolved, NULL otherwise */
+    packet_buffer_t *pending[ARP_PENDING_MAX]; /* Packets waiting for resolution */
+    uint8_t pending_count;    /* Packets in pending[] */
     struct arp_entry *next;   /* Pointer for hash collision resolution */
+    struct arp_entry *free_next; /* Next entry of the free list */
+    struct arp_table_s *table; /* Table whose pool the entry belongs to */
+    rcu_head_t rcu;           /* Deferred return to the pool after removal */
 } arp_entry_t;
 
+/* Memory arena the pool chunks are carved from */
+#define ARP_POOL_ARENA "arp"
+
+/* Block of pool entries; entries never move once handed out */
+typedef struct arp_pool_chunk {
+    struct arp_pool_chunk *next;
+    arp_entry_t entries[ARP_POOL_CHUNK];
+} arp_pool_chunk_t;
+
+/* Hash buckets; a resize publishes a new array twice the size */
+typedef struct {
+    uint32_t mask;            /* Buckets - 1 */
+    rcu_head_t rcu;           /* Deferred free once every chain has moved out */
+    arp_entry_t *heads[];     /* Chain heads */
+} arp_hash_t;
+
+/* Token bucket for ARP requests, kept as a theoretical arrival time */
+typedef struct {
+    uint64_t tat;             /* When the bucket is full again (ns) */
+    uint64_t interval_ns;     /* Time one request costs, 0 if unlimited */
+    uint64_t depth_ns;        /* Burst tolerance (ns) */
+} arp_bucket_t;
+
 /* ARP table structure */
 struct arp_table_s {
-    arp_entry_t *hash_table[ARP_CACHE_SIZE]; /* Hash table buckets */
-    arp_entry_t *entry_pool;                 /* Pre-allocated entries pool */
-    uint16_t entry_count;                    /* Number of entries in use */
+    arp_hash_t *hash;                        /* Buckets new entries go to */
+    arp_hash_t *old_hash;                    /* Buckets being migrated into hash, NULL unless resizing */
+    uint32_t migrated;                       /* Buckets of old_hash already migrated */
+    uint32_t resize_seq;                     /* Odd while a migration moves entries between chains */
+    arp_pool_chunk_t *entry_pool;            /* Chunks backing every entry, grown up to max_entries + ARP_RETIRE_SLACK */
+    uint32_t pool_size;                      /* Entries allocated in the chunks */
+    arp_entry_t *free_list;                  /* Entries ready for reuse, pushed by RCU callbacks */
+    uint32_t entry_count;                    /* Number of entries in use */
+    uint32_t max_entries;                    /* Entries before the oldest is recycled, grows up to ARP_GROW_MAX */
     uint32_t timeout;                        /* ARP cache timeout in seconds */
+    ip_addr_type_t family;                   /* IP_TYPE_V4 for ARP, IP_TYPE_V6 for Neighbor Discovery */
     bool initialized;                        /* Initialization flag */
     arp_stats_t stats;                       /* ARP statistics */
+    spinlock_t lock;                         /* Serializes writers; readers take no lock */
+    arp_bucket_t request_global;             /* Requests from the whole switch, under the lock */
+    arp_bucket_t request_port[CONFIG_MAX_PORTS]; /* Requests out of each port, under the lock */
+    arp_entry_t *wheel_l0[ARP_WHEEL_L0_SLOTS]; /* Timers due within ARP_WHEEL_L0_SLOTS seconds */
+    arp_entry_t *wheel_l1[ARP_WHEEL_L1_SLOTS]; /* Later timers, by level 0 turn */
+    uint32_t wheel_time;                     /* Second the wheel has advanced to */
 } ;
 
 ///typedef struct {
@@ -92,16 +249,53 @@ struct arp_table_s {
 
 /* Function prototypes for internal use */
 static uint32_t hash_ipv4(const ipv4_addr_t *ipv4);
-static arp_entry_t *arp_find_entry(arp_table_t *table, const ipv4_addr_t *ipv4);
+static inline size_t arp_addr_len(const arp_table_t *table);
+static uint32_t arp_hash_addr(const arp_table_t *table, const void *addr);
+static arp_entry_t *arp_find_entry(arp_table_t *table, const void *addr);
 static arp_entry_t *arp_allocate_entry(arp_table_t *table);
+static bool arp_pool_grow(arp_table_t *table);
 static void arp_free_entry(arp_table_t *table, arp_entry_t *entry);
+static void arp_entry_reclaim(rcu_head_t *head);
+static void arp_link_entry(arp_table_t *table, arp_entry_t *entry);
+static arp_hash_t *arp_hash_alloc(uint32_t buckets);
+static void arp_hash_free(arp_hash_t *hash);
+static arp_entry_t **arp_chain(arp_table_t *table, uint32_t hash);
+static uint32_t arp_chain_count(const arp_table_t *table);
+static arp_entry_t **arp_chain_at(arp_table_t *table, uint32_t index);
+static void arp_resize_step(arp_table_t *table, uint32_t steps);
+static void arp_unlink_entry(arp_table_t *table, arp_entry_t **link, arp_entry_t *entry);
+static void arp_remove_locked(arp_table_t *table, arp_entry_t *entry);
+static void arp_timer_arm(arp_table_t *table, arp_entry_t *entry, uint32_t deadline);
+static void arp_timer_cancel(arp_entry_t *entry);
+static void arp_timer_splice(arp_entry_t **to, arp_entry_t **from);
+static void arp_publish_rewrite(arp_entry_t *entry);
+static void arp_drop_pending(arp_table_t *table, arp_entry_t *entry);
+static void arp_bucket_set(arp_bucket_t *bucket, uint32_t rate, uint32_t burst);
+static bool arp_request_begin(arp_table_t *table, arp_entry_t *entry, bool retry);
+static uint64_t arp_now_ns(void);
+static void arp_send_pending(arp_table_t *table, const arp_rewrite_t *rewrite,
+                             packet_buffer_t **pkts, uint32_t count);
 static status_t arp_send_request(arp_table_t *table, const ipv4_addr_t *target_ip, uint16_t port_index);
+static status_t nd_send_solicit(arp_table_t *table, const ipv6_addr_t *target_ip, uint16_t port_index);
+static uint16_t nd_checksum(const ipv6_addr_t *src, const ipv6_addr_t *dst, const void *msg, uint32_t len);
+static status_t arp_solicit(arp_table_t *table, const void *addr, uint16_t port_index);
+static status_t arp_learn(arp_table_t *table, const void *addr, const mac_addr_t *mac, uint16_t port_index);
+static status_t arp_learn_locked(arp_table_t *table, const void *addr, const mac_addr_t *mac,
+                                 uint16_t port_index, packet_buffer_t **pending,
+                                 uint32_t *pending_count, arp_rewrite_t *rewrite);
+static status_t arp_hold_packet(arp_table_t *table, const void *addr, uint16_t port_index,
+                                const packet_buffer_t *packet);
+static status_t arp_forget(arp_table_t *table, const void *addr);
+static status_t arp_forget_locked(arp_table_t *table, const void *addr);
 static status_t arp_send_reply(arp_table_t *table, const ipv4_addr_t *target_ip, const mac_addr_t *target_mac,
                                const ipv4_addr_t *sender_ip, uint16_t port_index);
 static status_t arp_process_packet(arp_table_t *table, const packet_buffer_t *packet, uint16_t port_index);
+static const arp_packet_t *arp_parse_packet(arp_table_t *table, const packet_buffer_t *packet);
+static status_t arp_process_operation(arp_table_t *table, const arp_packet_t *arp_packet, uint16_t port_index);
 static uint32_t get_current_time(void);
 
 /* Convert internal state to public API state */
+static inline void arp_note_use(arp_entry_t *entry);
 static uint8_t arp_state_to_public(arp_state_t state) {
     switch (state) {
         case ARP_STATE_INCOMPLETE: return ARP_ENTRY_STATE_INCOMPLETE;
@@ -114,6 +308,21 @@ static uint8_t arp_state_to_public(arp_state_t state) {
     }
 }
 
+/* Move an entry to a state; lookups read it without the table lock */
+static void arp_set_state(arp_entry_t *entry, arp_state_t state) {
+    __atomic_store_n(&entry->state, state, __ATOMIC_RELAXED);
+#if CONFIG_ENABLE_TRACING
+    if (trace_enabled(TRACE_ARP_STATE)) {
+        bool v6 = entry->table->family == IP_TYPE_V6;
+        uint64_t addr[2] = { 0, 0 };
+
+        memcpy(addr, &entry->addr, v6 ? sizeof(ipv6_addr_t) : sizeof(ipv4_addr_t));
+        trace_record(TRACE_ARP_STATE, (uint32_t)entry->port_index << 16 | (v6 ? 6u : 4u) << 8 | state,
+                     addr[0], addr[1]);
+    }
+#endif
+}
+
 
 // Функция-геттер для получения указателя на ARP-таблицу
 arp_table_t* arp_table_get_instance(void) {
@@ -136,25 +345,39 @@ status_t arp_init(arp_table_t *table) {
 
     /* Clear the ARP table structure */
     memset(table, 0, sizeof(arp_table_t));
+    spinlock_init(&table->lock);
+    keyed_hash_init();
+    table->max_entries = ARP_CACHE_SIZE;
 
-    /* Pre-allocate ARP entries */
-    table->entry_pool = (arp_entry_t *)calloc(ARP_CACHE_SIZE, sizeof(arp_entry_t));
-    if (!table->entry_pool) {
+    /* Pre-allocate the buckets and the first chunk of ARP entries; both grow on demand */
+    table->hash = arp_hash_alloc(ARP_HASH_SIZE);
+    if (!table->hash || !arp_pool_grow(table)) {
         LOG_ERROR(LOG_CATEGORY_L3, "Failed to allocate memory for ARP cache entries");
+        arp_hash_free(table->hash);
+        table->hash = NULL;
         return STATUS_NO_MEMORY;
     }
 
-    /* Initialize ARP cache timeout */
+    /* Initialize ARP cache timeout, request limits and the timing wheel */
     table->timeout = ARP_CACHE_TIMEOUT_SEC;
+    table->family = IP_TYPE_V4;
+    table->wheel_time = get_current_time();
+    arp_bucket_set(&table->request_global, ARP_REQUEST_RATE_GLOBAL, 0);
+    for (int i = 0; i < CONFIG_MAX_PORTS; i++) {
+        arp_bucket_set(&table->request_port[i], ARP_REQUEST_RATE_PORT, 0);
+    }
     table->initialized = true;
 
-    LOG_INFO( LOG_CATEGORY_L3, "ARP module initialized successfully, cache size: %d entries", ARP_CACHE_SIZE);
+    LOG_INFO( LOG_CATEGORY_L3, "ARP module initialized successfully, cache size: %u entries, growing up to %u",
+              table->max_entries, ARP_GROW_MAX);
     return STATUS_SUCCESS;
 }
 
 /**
  * @brief Clean up the ARP module resources
  *
+ * No lookup may still be running on the table.
+ *
  * @param table Pointer to ARP table structure
  * @return status_t Status code indicating success or failure
  */
@@ -171,12 +394,21 @@ status_t arp_deinit(arp_table_t *table) {
 
     LOG_INFO( LOG_CATEGORY_L3, "Cleaning up ARP module resources");
 
+    /* Retire every entry, then let the grace period return them to the pool */
+    arp_flush(table);
+    rcu_synchronize();
+
     /* Free the entry pool */
-    if (table->entry_pool) {
-        free(table->entry_pool);
-        table->entry_pool = NULL;
+    while (table->entry_pool) {
+        arp_pool_chunk_t *chunk = table->entry_pool;
+        table->entry_pool = chunk->next;
+        mem_arena_free(mem_arena_get(ARP_POOL_ARENA), chunk, sizeof(arp_pool_chunk_t));
     }
 
+    /* Free the buckets, both arrays if a resize was under way */
+    arp_hash_free(table->old_hash);
+    arp_hash_free(table->hash);
+
     /* Reset table structure */
     memset(table, 0, sizeof(arp_table_t));
 
@@ -187,6 +419,9 @@ status_t arp_deinit(arp_table_t *table) {
 /**
  * @brief Add or update an entry in the ARP cache
  *
+ * The neighbor's rewrite string is rebuilt and published, so forwarding
+ * threads switch to the new MAC without taking a lock.
+ *
  * @param table Pointer to ARP table structure
  * @param ipv4 IPv4 address
  * @param mac MAC address
@@ -211,15 +446,95 @@ status_t arp_add_entry(arp_table_t *table, const ipv4_addr_t *ipv4, const mac_ad
               (*ipv4 )      & 0xFF
               );
 
+    status_t status = arp_learn(table, ipv4, mac, port_index);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    /* Update MAC table as well to ensure L2 forwarding works properly */
+    /* This is assuming we have a function to update the MAC table */
+    
+    mac_table_add(*mac, port_index, VLAN_ID_DEFAULT, false);
+    
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Add or update a neighbor of either family
+ *
+ * Publishes the neighbor's rewrite and sends the packets that waited for
+ * it. Takes the table lock.
+ *
+ * @param table Pointer to ARP or ND table structure
+ * @param addr Address of the table's family
+ * @param mac MAC address
+ * @param port_index Port index where the MAC was learned
+ * @return status_t Status code indicating success or failure
+ */
+static status_t arp_learn(arp_table_t *table, const void *addr, const mac_addr_t *mac, uint16_t port_index) {
+    packet_buffer_t *pending[ARP_PENDING_MAX];
+    uint32_t pending_count = 0;
+    arp_rewrite_t rewrite;
+
+    ARP_LOCK(table);
+    status_t status = arp_learn_locked(table, addr, mac, port_index, pending, &pending_count, &rewrite);
+    ARP_UNLOCK(table);
+
+    if (pending_count > 0) {
+        arp_send_pending(table, &rewrite, pending, pending_count);
+    }
+
+    return status;
+}
+
+/**
+ * @brief Add or update a neighbor with the table lock held
+ *
+ * The rewrite is republished only when the MAC or port changed, so a
+ * neighbor that announces itself again costs no adjacency change. Packets
+ * that waited for the neighbor are handed back in pending, to be sent with
+ * rewrite once the lock is dropped.
+ *
+ * @param table Pointer to ARP or ND table structure
+ * @param addr Address of the table's family
+ * @param mac MAC address
+ * @param port_index Port index where the MAC was learned
+ * @param[out] pending Room for ARP_PENDING_MAX packets
+ * @param[out] pending_count Number of packets stored in pending
+ * @param[out] rewrite Rewrite to send the pending packets with
+ * @return status_t Status code indicating success or failure
+ */
+static status_t arp_learn_locked(arp_table_t *table, const void *addr, const mac_addr_t *mac,
+                                 uint16_t port_index, packet_buffer_t **pending,
+                                 uint32_t *pending_count, arp_rewrite_t *rewrite) {
+    *pending_count = 0;
+
     /* Look for existing entry */
-    arp_entry_t *entry = arp_find_entry(table, ipv4);
+    arp_entry_t *entry = arp_find_entry(table, addr);
     
     if (entry) {
+        bool changed = !entry->rewrite || entry->port_index != port_index ||
+                       memcmp(&entry->mac, mac, sizeof(mac_addr_t)) != 0;
+
         /* Update existing entry */
         memcpy(&entry->mac, mac, sizeof(mac_addr_t));
         entry->port_index = port_index;
         entry->updated_time = get_current_time();
-        entry->state = ARP_STATE_REACHABLE;
+        entry->retry_count = 0;
+        entry->used = false;
+        arp_set_state(entry, ARP_STATE_REACHABLE);
+        if (changed) {
+            arp_publish_rewrite(entry);
+        }
+        arp_timer_arm(table, entry, entry->updated_time + table->timeout);
+
+        /* Packets that waited for the reply leave once the lock is dropped */
+        if (entry->pending_count > 0 && entry->rewrite) {
+            *pending_count = entry->pending_count;
+            memcpy(pending, entry->pending, entry->pending_count * sizeof(pending[0]));
+            entry->pending_count = 0;
+            *rewrite = entry->rewrite->rewrite;
+        }
         
         LOG_DEBUG( LOG_CATEGORY_L3, "Updated existing ARP entry");
     } else {
@@ -231,28 +546,22 @@ status_t arp_add_entry(arp_table_t *table, const ipv4_addr_t *ipv4, const mac_ad
         }
         
         /* Initialize new entry */
-        memcpy(&entry->ip, ipv4, sizeof(ipv4_addr_t));
+        memcpy(&entry->addr, addr, arp_addr_len(table));
         memcpy(&entry->mac, mac, sizeof(mac_addr_t));
         entry->port_index = port_index;
         entry->created_time = get_current_time();
         entry->updated_time = entry->created_time;
-        entry->state = ARP_STATE_REACHABLE;
+        arp_set_state(entry, ARP_STATE_REACHABLE);
         entry->retry_count = 0;
+        arp_publish_rewrite(entry);
         
         /* Add to hash table */
-        uint32_t hash = hash_ipv4(ipv4) % ARP_CACHE_SIZE;
-        entry->next = table->hash_table[hash];
-        table->hash_table[hash] = entry;
-        table->entry_count++;
+        arp_link_entry(table, entry);
+        arp_timer_arm(table, entry, entry->updated_time + table->timeout);
         
         LOG_DEBUG( LOG_CATEGORY_L3, "Added new ARP entry, current count: %d", table->entry_count);
     }
     
-    /* Update MAC table as well to ensure L2 forwarding works properly */
-    /* This is assuming we have a function to update the MAC table */
-    
-    mac_table_add(*mac, port_index, VLAN_ID_DEFAULT, false);
-    
     table->stats.entries_added++;
     return STATUS_SUCCESS;
 }
@@ -260,6 +569,10 @@ status_t arp_add_entry(arp_table_t *table, const ipv4_addr_t *ipv4, const mac_ad
 /**
  * @brief Look up an entry in the ARP cache
  *
+ * A resolved neighbor is answered from its rewrite string without taking
+ * the table lock; anything else falls back to the locked path, which
+ * starts resolution when the address is unknown.
+ *
  * @param table Pointer to ARP table structure
  * @param ipv4 IPv4 address to look up
  * @param mac_result Pointer to store the resulting MAC address
@@ -285,6 +598,29 @@ status_t arp_lookup(arp_table_t *table, const ipv4_addr_t *ipv4, mac_addr_t *mac
               );
               //ipv4->bytes[0], ipv4->bytes[1], ipv4->bytes[2], ipv4->bytes[3]);
 
+    /* Resolved neighbors are served lock-free from their rewrite string */
+    if (rcu_read_lock() == STATUS_SUCCESS) {
+        arp_entry_t *found = arp_find_entry(table, ipv4);
+        const arp_rewrite_node_t *node = found ?
+            __atomic_load_n(&found->rewrite, __ATOMIC_ACQUIRE) : NULL;
+
+        if (node) {
+            arp_note_use(found);
+            memcpy(mac_result->addr, node->rewrite.bytes, MAC_ADDR_LEN);
+            if (port_index_result) {
+                *port_index_result = node->rewrite.port_index;
+            }
+            rcu_read_unlock();
+
+            __atomic_fetch_add(&table->stats.cache_hits, 1, __ATOMIC_RELAXED);
+            LOG_DEBUG( LOG_CATEGORY_L3, "ARP entry found");
+            return STATUS_SUCCESS;
+        }
+        rcu_read_unlock();
+    }
+
+    ARP_LOCK(table);
+
     /* Find entry in the cache */
     arp_entry_t *entry = arp_find_entry(table, ipv4);
     
@@ -298,6 +634,7 @@ status_t arp_lookup(arp_table_t *table, const ipv4_addr_t *ipv4, mac_addr_t *mac
         /* Create incomplete entry */
         arp_entry_t *new_entry = arp_allocate_entry(table);
         if (!new_entry) {
+            ARP_UNLOCK(table);
             LOG_ERROR(LOG_CATEGORY_L3, "Failed to allocate new ARP entry for resolution");
             return STATUS_RESOURCE_EXHAUSTED;
         }
@@ -308,18 +645,18 @@ status_t arp_lookup(arp_table_t *table, const ipv4_addr_t *ipv4, mac_addr_t *mac
         new_entry->port_index = out_port;
         new_entry->created_time = get_current_time();
         new_entry->updated_time = new_entry->created_time;
-        new_entry->state = ARP_STATE_INCOMPLETE;
+        arp_set_state(new_entry, ARP_STATE_INCOMPLETE);
         new_entry->retry_count = 0;
         
         /* Add to hash table */
-        uint32_t hash = hash_ipv4(ipv4) % ARP_CACHE_SIZE;
-        new_entry->next = table->hash_table[hash];
-        table->hash_table[hash] = new_entry;
-        table->entry_count++;
+        arp_link_entry(table, new_entry);
+        bool send_request = arp_request_begin(table, new_entry, false);
+        ARP_UNLOCK(table);
         
-        /* Send ARP request */
-        arp_send_request(table, ipv4, out_port);
-        table->stats.requests_sent++;
+        /* Send ARP request; a throttled one is retried by aging */
+        if (send_request) {
+            arp_send_request(table, ipv4, out_port);
+        }
         
         return ARP_STATUS_PENDING;
     }
@@ -327,9 +664,11 @@ status_t arp_lookup(arp_table_t *table, const ipv4_addr_t *ipv4, mac_addr_t *mac
     /* Entry exists, check if it's complete */
     if (entry->state != ARP_STATE_REACHABLE) {
         if (entry->state == ARP_STATE_INCOMPLETE) {
+            ARP_UNLOCK(table);
             LOG_DEBUG( LOG_CATEGORY_L3, "ARP resolution in progress");
             return ARP_STATUS_PENDING;
         } else if (entry->state == ARP_STATE_FAILED) {
+            ARP_UNLOCK(table);
             LOG_DEBUG( LOG_CATEGORY_L3, "ARP resolution previously failed");
             return STATUS_NOT_FOUND;
         }
@@ -342,12 +681,227 @@ status_t arp_lookup(arp_table_t *table, const ipv4_addr_t *ipv4, mac_addr_t *mac
     }
     
     /* Update statistics */
-    table->stats.cache_hits++;
+    __atomic_fetch_add(&table->stats.cache_hits, 1, __ATOMIC_RELAXED);
+    ARP_UNLOCK(table);
     
     LOG_DEBUG( LOG_CATEGORY_L3, "ARP entry found");
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Get the prebuilt L2 rewrite of a resolved neighbor
+ *
+ * Lock-free for resolved neighbors. Must be called inside an RCU read
+ * section; the rewrite stays valid until the section ends, even if the
+ * neighbor changes or is removed meanwhile. An unresolved neighbor is
+ * handed to arp_resolve_next_hop(), which starts resolution on port_index.
+ *
+ * @param ip_addr IPv4 address of the neighbor
+ * @param port_index Port to resolve on when the neighbor is unknown
+ * @param[out] rewrite Rewrite string to copy in front of the L3 header
+ * @return status_t STATUS_SUCCESS, ARP_STATUS_PENDING or another error code
+ */
+status_t arp_get_rewrite(const ipv4_addr_t *ip_addr, uint16_t port_index, const arp_rewrite_t **rewrite) {
+    arp_table_t *table = arp_table_get_instance();
+    const arp_rewrite_node_t *node = NULL;
+    arp_entry_t *entry;
+    mac_addr_t mac;
+    status_t status;
+
+    if (!ip_addr || !rewrite) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (!table->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    entry = arp_find_entry(table, ip_addr);
+    if (entry) {
+        node = __atomic_load_n(&entry->rewrite, __ATOMIC_ACQUIRE);
+    }
+
+    if (!node) {
+        status = arp_resolve_next_hop(ip_addr, port_index, &mac);
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+
+        /* Resolved meanwhile */
+        entry = arp_find_entry(table, ip_addr);
+        node = entry ? __atomic_load_n(&entry->rewrite, __ATOMIC_ACQUIRE) : NULL;
+        if (!node) {
+            return ARP_STATUS_PENDING;
+        }
+    } else {
+        arp_note_use(entry);
+        __atomic_fetch_add(&table->stats.cache_hits, 1, __ATOMIC_RELAXED);
+    }
+
+    *rewrite = &node->rewrite;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the neighbor generation
+ *
+ * The counter moves on whenever a rewrite of the ARP or ND table is
+ * published or its entry is removed, so a copy of a rewrite taken at one
+ * generation is still current while the generation has not moved.
+ *
+ * @return uint32_t Current generation
+ */
+uint32_t arp_get_generation(void) {
+    return __atomic_load_n(&g_arp_generation, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Set the VLAN a neighbor is reached through
+ *
+ * The neighbor's rewrite string carries an 802.1Q tag with this VLAN, so
+ * routed frames leave already tagged.
+ *
+ * @param table Pointer to ARP table structure
+ * @param ipv4 IPv4 address of the neighbor
+ * @param vlan_id VLAN to tag with, 0 to send untagged
+ * @return status_t Status code indicating success or failure
+ */
+status_t arp_set_egress_vlan(arp_table_t *table, const ipv4_addr_t *ipv4, uint16_t vlan_id) {
+    if (!table || !ipv4 || vlan_id > 4094) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameter(s) in arp_set_egress_vlan");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (!table->initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "ARP module not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    ARP_LOCK(table);
+    arp_entry_t *entry = arp_find_entry(table, ipv4);
+    if (!entry) {
+        ARP_UNLOCK(table);
+        return STATUS_NOT_FOUND;
+    }
+
+    entry->vlan_id = vlan_id;
+    if (entry->state == ARP_STATE_REACHABLE) {
+        arp_publish_rewrite(entry);
+    }
+    ARP_UNLOCK(table);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Hold a packet until its next hop is resolved
+ *
+ * A copy of the packet waits on the neighbor's entry and is sent, with the
+ * neighbor's rewrite in front of it, in one burst when the reply arrives.
+ * Only the first packet to an unknown neighbor sends a request; the others
+ * wait for the same reply, and retries are left to arp_age_entries(). The
+ * caller keeps ownership of packet.
+ *
+ * @param table Pointer to ARP table structure
+ * @param ipv4 IPv4 address of the next hop
+ * @param port_index Port to resolve on if the next hop is unknown
+ * @param packet Packet with the L3 header at offset 0
+ * @return status_t ARP_STATUS_PENDING if the packet is held or was sent,
+ *         ARP_STATUS_QUEUE_FULL if the neighbor already holds ARP_PENDING_MAX
+ *         packets, or another error code
+ */
+status_t arp_queue_packet(arp_table_t *table, const ipv4_addr_t *ipv4, uint16_t port_index,
+                          const packet_buffer_t *packet) {
+    if (!table || !ipv4 || !packet) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameter(s) in arp_queue_packet");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (!table->initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "ARP module not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    return arp_hold_packet(table, ipv4, port_index, packet);
+}
+
+/**
+ * @brief Hold a packet on a neighbor of either family
+ *
+ * @param table Pointer to ARP or ND table structure
+ * @param addr Address of the table's family
+ * @param port_index Port to resolve on if the neighbor is unknown
+ * @param packet Packet with the L3 header at offset 0
+ * @return status_t As arp_queue_packet()
+ */
+static status_t arp_hold_packet(arp_table_t *table, const void *addr, uint16_t port_index,
+                                const packet_buffer_t *packet) {
+    packet_buffer_t *copy;
+    arp_rewrite_t rewrite;
+    bool send_request = false;
+    bool resolved = false;
+
+    ARP_LOCK(table);
+    arp_entry_t *entry = arp_find_entry(table, addr);
+
+    if (entry && entry->state == ARP_STATE_FAILED) {
+        table->stats.pending_dropped++;
+        ARP_UNLOCK(table);
+        return STATUS_NOT_FOUND;
+    }
+
+    if (entry && entry->pending_count >= ARP_PENDING_MAX) {
+        table->stats.pending_dropped++;
+        ARP_UNLOCK(table);
+        return ARP_STATUS_QUEUE_FULL;
+    }
+
+    copy = packet_buffer_clone_shared(packet);
+    if (!copy) {
+        table->stats.pending_dropped++;
+        ARP_UNLOCK(table);
+        return STATUS_NO_MEMORY;
+    }
+
+    if (!entry) {
+        /* First packet to this neighbor: start resolution */
+        entry = arp_allocate_entry(table);
+        if (!entry) {
+            table->stats.pending_dropped++;
+            ARP_UNLOCK(table);
+            packet_buffer_free(copy);
+            return STATUS_RESOURCE_EXHAUSTED;
+        }
+
+        memcpy(&entry->addr, addr, arp_addr_len(table));
+        entry->port_index = port_index;
+        entry->created_time = get_current_time();
+        entry->updated_time = entry->created_time;
+        arp_set_state(entry, ARP_STATE_INCOMPLETE);
+        arp_link_entry(table, entry);
+        send_request = arp_request_begin(table, entry, false);
+    }
+
+    if (entry->rewrite) {
+        /* Resolved since the caller missed */
+        rewrite = entry->rewrite->rewrite;
+        resolved = true;
+    } else {
+        entry->pending[entry->pending_count++] = copy;
+        table->stats.pending_queued++;
+    }
+    ARP_UNLOCK(table);
+
+    if (resolved) {
+        arp_send_pending(table, &rewrite, &copy, 1);
+    }
+    if (send_request) {
+        arp_solicit(table, addr, port_index);
+    }
+
+    return ARP_STATUS_PENDING;
+}
+
 /**
  * @brief Remove an entry from the ARP cache
  *
@@ -373,34 +927,53 @@ status_t arp_remove_entry(arp_table_t *table, const ipv4_addr_t *ipv4) {
                 (*ipv4 )      & 0xFF
               );
 
-    uint32_t hash = hash_ipv4(ipv4) % ARP_CACHE_SIZE;
-    arp_entry_t *entry = table->hash_table[hash];
-    arp_entry_t *prev = NULL;
+    return arp_forget(table, ipv4);
+}
+
+/**
+ * @brief Remove a neighbor of either family
+ *
+ * @param table Pointer to ARP or ND table structure
+ * @param addr Address of the table's family
+ * @return status_t Status code indicating success or failure
+ */
+static status_t arp_forget(arp_table_t *table, const void *addr) {
+    ARP_LOCK(table);
+    status_t status = arp_forget_locked(table, addr);
+    ARP_UNLOCK(table);
+
+    if (status != STATUS_SUCCESS) {
+        LOG_DEBUG( LOG_CATEGORY_L3, "ARP entry not found for removal");
+    }
+    return status;
+}
+
+/**
+ * @brief Remove a neighbor of either family with the table lock held
+ *
+ * @param table Pointer to ARP or ND table structure
+ * @param addr Address of the table's family
+ * @return status_t STATUS_SUCCESS or STATUS_NOT_FOUND
+ */
+static status_t arp_forget_locked(arp_table_t *table, const void *addr) {
+    arp_entry_t **link = arp_chain(table, arp_hash_addr(table, addr));
+    arp_entry_t *entry = *link;
     
     /* Search for the entry in the hash chain */
     while (entry) {
-        if (memcmp(&entry->ip, ipv4, sizeof(ipv4_addr_t)) == 0) {
+        if (memcmp(&entry->addr, addr, arp_addr_len(table)) == 0) {
             /* Found the entry, remove it from the hash chain */
-            if (prev) {
-                prev->next = entry->next;
-            } else {
-                table->hash_table[hash] = entry->next;
-            }
-            
-            /* Free the entry */
-            arp_free_entry(table, entry);
-            table->entry_count--;
+            arp_unlink_entry(table, link, entry);
             table->stats.entries_removed++;
             
             LOG_DEBUG( LOG_CATEGORY_L3, "ARP entry removed, current count: %d", table->entry_count);
             return STATUS_SUCCESS;
         }
         
-        prev = entry;
+        link = &entry->next;
         entry = entry->next;
     }
     
-     LOG_DEBUG( LOG_CATEGORY_L3, "ARP entry not found for removal");
     return STATUS_NOT_FOUND;
 }
 
@@ -426,11 +999,36 @@ static status_t arp_process_packet(arp_table_t *table, const packet_buffer_t *pa
 
     LOG_DEBUG( LOG_CATEGORY_L3, "Processing ARP packet received on port %d", port_index);
 
+    const arp_packet_t *arp_packet = arp_parse_packet(table, packet);
+    if (!arp_packet) {
+        return STATUS_INVALID_PACKET;
+    }
+    
+    /* Learn sender's IP-to-MAC mapping regardless of packet type */
+    ipv4_addr_t sender_ip;
+    mac_addr_t sender_mac;
+    memcpy(&sender_ip, &arp_packet->sender_ip, sizeof(ipv4_addr_t));
+    memcpy(&sender_mac, &arp_packet->sender_mac, sizeof(mac_addr_t));
+    
+    /* Update ARP cache with sender's info */
+    arp_add_entry(table, &sender_ip, &sender_mac, port_index);
+    
+    return arp_process_operation(table, arp_packet, port_index);
+}
+
+/**
+ * @brief Validate a received ARP packet
+ *
+ * @param table Pointer to ARP table structure
+ * @param packet Pointer to the packet structure
+ * @return const arp_packet_t* The ARP packet, or NULL if it is invalid
+ */
+static const arp_packet_t *arp_parse_packet(arp_table_t *table, const packet_buffer_t *packet) {
     /* Verify packet size */
     if (packet->size < sizeof(arp_packet_t)) {
          LOG_WARNING( LOG_CATEGORY_L3, "Received ARP packet is too small: %d bytes", packet->size);
         table->stats.invalid_packets++;
-        return STATUS_INVALID_PACKET;
+        return NULL;
     }
     
     /* Parse ARP packet */
@@ -444,20 +1042,29 @@ static status_t arp_process_packet(arp_table_t *table, const packet_buffer_t *pa
         
          LOG_WARNING( LOG_CATEGORY_L3, "Invalid ARP packet format");
         table->stats.invalid_packets++;
-        return STATUS_INVALID_PACKET;
+        return NULL;
     }
-    
+
+    return arp_packet;
+}
+
+/**
+ * @brief Act on the operation of a validated ARP packet
+ *
+ * The sender has already been learned by the caller.
+ *
+ * @param table Pointer to ARP table structure
+ * @param arp_packet Validated ARP packet
+ * @param port_index Port index where the packet was received
+ * @return status_t Status code indicating success or failure
+ */
+static status_t arp_process_operation(arp_table_t *table, const arp_packet_t *arp_packet, uint16_t port_index) {
     uint16_t operation = ntohs(arp_packet->operation);
-    
-    /* Learn sender's IP-to-MAC mapping regardless of packet type */
     ipv4_addr_t sender_ip;
     mac_addr_t sender_mac;
     memcpy(&sender_ip, &arp_packet->sender_ip, sizeof(ipv4_addr_t));
     memcpy(&sender_mac, &arp_packet->sender_mac, sizeof(mac_addr_t));
     
-    /* Update ARP cache with sender's info */
-    arp_add_entry(table, &sender_ip, &sender_mac, port_index);
-    
     /* Process based on ARP operation */
     switch (operation) {
         case ARP_OP_REQUEST: {
@@ -511,14 +1118,29 @@ status_t arp_handle_frame(packet_buffer_t *packet) {
 }
 
 /**
- * @brief Flush all entries from the ARP cache
+ * @brief Handle a burst of incoming ARP frames
  *
- * @param table Pointer to ARP table structure
- * @return status_t Status code indicating success or failure
+ * Frames are learned in groups of ARP_BULK_MAX. Within a group the updates
+ * are ordered by hash bucket, reduced to the last one per sender and
+ * applied in a single critical section, so a flood of gratuitous ARPs for
+ * one neighbor republishes its rewrite and updates the MAC table once.
+ *
+ * @param packets Incoming Ethernet packets carrying ARP payloads
+ * @param count Number of packets
+ * @return status_t STATUS_SUCCESS if every frame was processed, otherwise
+ *         the error of the last frame that was not; valid frames are processed
+ *         either way
  */
-status_t arp_flush(arp_table_t *table) {
-    if (!table) {
-        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameter: NULL ARP table pointer");
+status_t arp_handle_frames_bulk(packet_buffer_t **packets, uint32_t count) {
+    arp_table_t *table = &g_arp_table;
+    arp_update_t updates[ARP_BULK_MAX];
+    packet_buffer_t *pending[ARP_BULK_MAX][ARP_PENDING_MAX];
+    uint32_t pending_count[ARP_BULK_MAX];
+    arp_rewrite_t rewrite[ARP_BULK_MAX];
+    bool learned[ARP_BULK_MAX];
+    status_t result = STATUS_SUCCESS;
+
+    if (!packets && count > 0) {
         return STATUS_INVALID_PARAMETER;
     }
 
@@ -527,35 +1149,213 @@ status_t arp_flush(arp_table_t *table) {
         return STATUS_NOT_INITIALIZED;
     }
 
-    LOG_INFO( LOG_CATEGORY_L3, "Flushing ARP cache");
+    for (uint32_t base = 0; base < count; base += ARP_BULK_MAX) {
+        uint32_t burst = count - base < ARP_BULK_MAX ? count - base : ARP_BULK_MAX;
+        uint32_t n = 0;
+
+        /* Parse the group and keep the updates sorted by bucket, then by arrival */
+        for (uint32_t i = 0; i < burst; i++) {
+            const packet_buffer_t *packet = packets[base + i];
+            const arp_packet_t *arp_packet = packet ? arp_parse_packet(table, packet) : NULL;
+            if (!arp_packet) {
+                result = packet ? STATUS_INVALID_PACKET : STATUS_INVALID_PARAMETER;
+                continue;
+            }
 
-    /* Free all entries in hash buckets */
-    for (int i = 0; i < ARP_CACHE_SIZE; i++) {
-        arp_entry_t *entry = table->hash_table[i];
-        
-        while (entry) {
-            arp_entry_t *next = entry->next;
-            arp_free_entry(table, entry);
-            entry = next;
+            arp_update_t update;
+            memcpy(&update.ip, &arp_packet->sender_ip, sizeof(ipv4_addr_t));
+            memcpy(&update.mac, &arp_packet->sender_mac, sizeof(mac_addr_t));
+            update.port_index = packet->metadata.port;
+            update.bucket = hash_ipv4(&update.ip);
+
+            uint32_t pos = n++;
+            while (pos > 0 && updates[pos - 1].bucket > update.bucket) {
+                updates[pos] = updates[pos - 1];
+                pos--;
+            }
+            updates[pos] = update;
+
+            status_t status = arp_process_operation(table, arp_packet, update.port_index);
+            if (status != STATUS_SUCCESS) {
+                result = status;
+            }
         }
-        
-        table->hash_table[i] = NULL;
-    }
-    
-    table->entry_count = 0;
-    table->stats.cache_flushes++;
-    
-    LOG_INFO( LOG_CATEGORY_L3, "ARP cache flushed successfully");
-    return STATUS_SUCCESS;
-}
 
-/**
- * @brief Age out old entries from the ARP cache
- *
- * @param table Pointer to ARP table structure
- * @return status_t Status code indicating success or failure
- */
-status_t arp_age_entries(arp_table_t *table) {
+        /* Only the last update of each sender survives */
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t k = kept;
+            while (k > 0 && updates[k - 1].bucket == updates[i].bucket && updates[k - 1].ip != updates[i].ip) {
+                k--;
+            }
+            if (k > 0 && updates[k - 1].bucket == updates[i].bucket) {
+                updates[k - 1] = updates[i];
+            } else {
+                updates[kept++] = updates[i];
+            }
+        }
+
+        ARP_LOCK(table);
+        for (uint32_t i = 0; i < kept; i++) {
+            status_t status = arp_learn_locked(table, &updates[i].ip, &updates[i].mac, updates[i].port_index,
+                                               pending[i], &pending_count[i], &rewrite[i]);
+            learned[i] = status == STATUS_SUCCESS;
+            if (!learned[i]) {
+                result = status;
+            }
+        }
+        ARP_UNLOCK(table);
+
+        for (uint32_t i = 0; i < kept; i++) {
+            if (pending_count[i] > 0) {
+                arp_send_pending(table, &rewrite[i], pending[i], pending_count[i]);
+            }
+            if (learned[i]) {
+                mac_table_add(updates[i].mac, updates[i].port_index, VLAN_ID_DEFAULT, false);
+            }
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief Add or update many neighbors of a table
+ *
+ * Neighbors are applied in groups of ARP_BULK_MAX, each in one critical
+ * section; packets waiting for them are sent and the MAC table updated
+ * once the group's lock is dropped.
+ *
+ * @param table Pointer to ARP or ND table structure
+ * @param neighbors Neighbors, of the table's family
+ * @param count Number of neighbors
+ * @param stop_on_error Stop at the first neighbor that fails
+ * @param[out] statuses Status of each neighbor, may be NULL; neighbors not
+ *             tried after a failure get STATUS_NOT_EXECUTED
+ * @return status_t STATUS_SUCCESS if every neighbor was added, otherwise
+ *         the error of the last one that was not
+ */
+status_t arp_add_neighbors_bulk(arp_table_t *table, const arp_neighbor_t *neighbors, uint32_t count,
+                                bool stop_on_error, status_t *statuses) {
+    packet_buffer_t *pending[ARP_BULK_MAX][ARP_PENDING_MAX];
+    uint32_t pending_count[ARP_BULK_MAX];
+    arp_rewrite_t rewrite[ARP_BULK_MAX];
+    status_t status[ARP_BULK_MAX];
+    status_t result = STATUS_SUCCESS;
+    uint32_t done = 0;
+    bool stop = false;
+
+    if (!table || (!neighbors && count > 0)) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameter(s) in arp_add_neighbors_bulk");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (!table->initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "ARP module not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    while (done < count && !stop) {
+        uint32_t burst = count - done < ARP_BULK_MAX ? count - done : ARP_BULK_MAX;
+        uint32_t n = 0;
+
+        ARP_LOCK(table);
+        while (n < burst && !stop) {
+            const arp_neighbor_t *neighbor = &neighbors[done + n];
+
+            status[n] = arp_learn_locked(table, &neighbor->addr, &neighbor->mac, neighbor->port_index,
+                                         pending[n], &pending_count[n], &rewrite[n]);
+            if (status[n] != STATUS_SUCCESS) {
+                result = status[n];
+                stop = stop_on_error;
+            }
+            n++;
+        }
+        ARP_UNLOCK(table);
+
+        for (uint32_t i = 0; i < n; i++) {
+            if (pending_count[i] > 0) {
+                arp_send_pending(table, &rewrite[i], pending[i], pending_count[i]);
+            }
+            if (status[i] == STATUS_SUCCESS) {
+                mac_table_add(neighbors[done + i].mac, neighbors[done + i].port_index, VLAN_ID_DEFAULT, false);
+            }
+            if (statuses) {
+                statuses[done + i] = status[i];
+            }
+        }
+        done += n;
+    }
+
+    if (statuses) {
+        for (; done < count; done++) {
+            statuses[done] = STATUS_NOT_EXECUTED;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief Remove many neighbors of a table in one critical section
+ *
+ * @param table Pointer to ARP or ND table structure
+ * @param neighbors Neighbors, of the table's family; only addresses are used
+ * @param count Number of neighbors
+ * @param stop_on_error Stop at the first neighbor that is not found
+ * @param[out] statuses Status of each neighbor, may be NULL; neighbors not
+ *             tried after a failure get STATUS_NOT_EXECUTED
+ * @return status_t STATUS_SUCCESS if every neighbor was removed, otherwise
+ *         the error of the last one that was not
+ */
+status_t arp_remove_neighbors_bulk(arp_table_t *table, const arp_neighbor_t *neighbors, uint32_t count,
+                                   bool stop_on_error, status_t *statuses) {
+    status_t result = STATUS_SUCCESS;
+    uint32_t i = 0;
+
+    if (!table || (!neighbors && count > 0)) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameter(s) in arp_remove_neighbors_bulk");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (!table->initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "ARP module not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    ARP_LOCK(table);
+    while (i < count) {
+        status_t status = arp_forget_locked(table, &neighbors[i].addr);
+
+        if (statuses) {
+            statuses[i] = status;
+        }
+        i++;
+        if (status != STATUS_SUCCESS) {
+            result = status;
+            if (stop_on_error) {
+                break;
+            }
+        }
+    }
+    ARP_UNLOCK(table);
+
+    if (statuses) {
+        for (; i < count; i++) {
+            statuses[i] = STATUS_NOT_EXECUTED;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief Flush all entries from the ARP cache
+ *
+ * @param table Pointer to ARP table structure
+ * @return status_t Status code indicating success or failure
+ */
+status_t arp_flush(arp_table_t *table) {
     if (!table) {
         LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameter: NULL ARP table pointer");
         return STATUS_INVALID_PARAMETER;
@@ -566,64 +1366,188 @@ status_t arp_age_entries(arp_table_t *table) {
         return STATUS_NOT_INITIALIZED;
     }
 
-    LOG_DEBUG( LOG_CATEGORY_L3, "Aging ARP cache entries");
+    LOG_INFO( LOG_CATEGORY_L3, "Flushing ARP cache");
 
-    uint32_t current_time = get_current_time();
-    uint32_t aged_count = 0;
+    ARP_LOCK(table);
+
+    /* Unlink all entries in hash buckets, head first */
+    for (uint32_t i = 0; i < arp_chain_count(table); i++) {
+        arp_entry_t **head = arp_chain_at(table, i);
+        while (*head) {
+            arp_unlink_entry(table, head, *head);
+        }
+    }
     
-    /* Check all entries in hash buckets */
-    for (int i = 0; i < ARP_CACHE_SIZE; i++) {
-        arp_entry_t *entry = table->hash_table[i];
-        arp_entry_t *prev = NULL;
-        
-        while (entry) {
-            arp_entry_t *next = entry->next;
-            
-            /* Check if entry has timed out */
-            if (entry->state == ARP_STATE_REACHABLE &&
-                (current_time - entry->updated_time) > table->timeout) {
-                
-                /* Remove from hash chain */
-                if (prev) {
-                    prev->next = next;
-                } else {
-                    table->hash_table[i] = next;
-                }
-                
-                /* Free the entry */
-                arp_free_entry(table, entry);
-                table->entry_count--;
-                aged_count++;
-                
-                /* Don't update prev since we removed the entry */
-            } else {
-                /* Handle incomplete entries that have timed out */
-                if (entry->state == ARP_STATE_INCOMPLETE) {
-                    if ((current_time - entry->updated_time) > ARP_REQUEST_RETRY_INTERVAL_MS / 1000) {
-                        if (entry->retry_count < ARP_REQUEST_RETRY_COUNT) {
-                            /* Retry ARP request */
-                            arp_send_request(table, &entry->ip, entry->port_index);
-                            entry->retry_count++;
-                            entry->updated_time = current_time;
-                            table->stats.requests_sent++;
-                        } else {
-                            /* Max retries reached, mark as failed */
-                            entry->state = ARP_STATE_FAILED;
-                        }
-                    }
+    table->stats.cache_flushes++;
+    ARP_UNLOCK(table);
+    
+    LOG_INFO( LOG_CATEGORY_L3, "ARP cache flushed successfully");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Run the state timer of one entry
+ *
+ * Called with the table lock held, once the entry's timer has fired and
+ * been cancelled. Requests are appended to the retry batch and sent after
+ * the lock is dropped; when the batch is full the entry retries a second
+ * later.
+ *
+ * @param table Pointer to ARP table structure
+ * @param entry Entry whose timer fired
+ * @param now Current time (s)
+ * @param retry_ip Addresses to resolve once the lock is dropped
+ * @param retry_port Ports of retry_ip[]
+ * @param retry_count Number of requests in the batch
+ * @return bool true if the entry was removed
+ */
+static bool arp_entry_expire(arp_table_t *table, arp_entry_t *entry, uint32_t now,
+                             arp_addr_t *retry_ip, uint16_t *retry_port, uint32_t *retry_count) {
+    /* Timers beyond the wheel span come back early */
+    if ((int32_t)(entry->timer_deadline - now) > 0) {
+        arp_timer_arm(table, entry, entry->timer_deadline);
+        return false;
+    }
+
+    switch (entry->state) {
+        case ARP_STATE_REACHABLE:
+            entry->used = false;
+            arp_set_state(entry, ARP_STATE_STALE);
+            arp_timer_arm(table, entry, now + ARP_STALE_TIMEOUT_SEC);
+            return false;
+
+        case ARP_STATE_STALE:
+            if (!__atomic_load_n(&entry->used, __ATOMIC_RELAXED)) {
+                arp_remove_locked(table, entry);
+                return true;
+            }
+            arp_set_state(entry, ARP_STATE_DELAY);
+            arp_timer_arm(table, entry, now + ARP_DELAY_SEC);
+            return false;
+
+        case ARP_STATE_DELAY:
+        case ARP_STATE_INCOMPLETE:
+        case ARP_STATE_PROBE:
+            if (entry->state != ARP_STATE_DELAY && entry->retry_count >= ARP_REQUEST_RETRY_COUNT) {
+                if (entry->state == ARP_STATE_PROBE) {
+                    /* The neighbor went away */
+                    arp_remove_locked(table, entry);
+                    return true;
                 }
-                
-                prev = entry;
+                /* Max retries reached, mark as failed */
+                arp_set_state(entry, ARP_STATE_FAILED);
+                arp_drop_pending(table, entry);
+                arp_timer_arm(table, entry, now + ARP_FAILED_HOLD_SEC);
+                return false;
+            }
+
+            if (*retry_count >= ARP_AGE_RETRY_BATCH) {
+                arp_timer_arm(table, entry, now + 1);
+                return false;
+            }
+
+            bool retry = entry->state != ARP_STATE_DELAY;
+            if (!retry) {
+                entry->retry_count = 0;
+                arp_set_state(entry, ARP_STATE_PROBE);
+            }
+            if (arp_request_begin(table, entry, retry)) {
+                retry_ip[*retry_count] = entry->addr;
+                retry_port[*retry_count] = entry->port_index;
+                (*retry_count)++;
+            }
+            return false;
+
+        case ARP_STATE_FAILED:
+        default:
+            arp_remove_locked(table, entry);
+            return true;
+    }
+}
+
+/**
+ * @brief Age out old entries from the ARP cache
+ *
+ * Advances the timing wheel to the current second and runs the timers that
+ * fired on the way, so a pass costs time proportional to the entries due.
+ *
+ * @param table Pointer to ARP table structure
+ * @return status_t Status code indicating success or failure
+ */
+status_t arp_age_entries(arp_table_t *table) {
+    if (!table) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameter: NULL ARP table pointer");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (!table->initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "ARP module not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    LOG_DEBUG( LOG_CATEGORY_L3, "Aging ARP cache entries");
+
+    arp_addr_t retry_ip[ARP_AGE_RETRY_BATCH];
+    uint16_t retry_port[ARP_AGE_RETRY_BATCH];
+    uint32_t retry_count = 0;
+    uint32_t aged_count = 0;
+    arp_entry_t *due = NULL;
+
+    ARP_LOCK(table);
+    uint32_t now = get_current_time();
+
+    if (now - table->wheel_time >= ARP_WHEEL_SPAN) {
+        /* The clock jumped past the wheel: every armed timer is examined */
+        for (uint32_t i = 0; i < ARP_WHEEL_L0_SLOTS; i++) {
+            arp_timer_splice(&due, &table->wheel_l0[i]);
+        }
+        for (uint32_t i = 0; i < ARP_WHEEL_L1_SLOTS; i++) {
+            arp_timer_splice(&due, &table->wheel_l1[i]);
+        }
+        table->wheel_time = now;
+    }
+
+    while ((int32_t)(now - table->wheel_time) > 0) {
+        table->wheel_time++;
+
+        /* A new level 0 turn: spread the level 1 slot of that turn over level 0 */
+        if ((table->wheel_time & (ARP_WHEEL_L0_SLOTS - 1)) == 0) {
+            arp_entry_t *turn = NULL;
+            arp_timer_splice(&turn, &table->wheel_l1[(table->wheel_time >> ARP_WHEEL_L0_BITS) &
+                                                     (ARP_WHEEL_L1_SLOTS - 1)]);
+            while (turn) {
+                arp_entry_t *entry = turn;
+                arp_timer_arm(table, entry, entry->timer_deadline);
             }
-            
-            entry = next;
+        }
+
+        arp_timer_splice(&due, &table->wheel_l0[table->wheel_time & (ARP_WHEEL_L0_SLOTS - 1)]);
+    }
+
+    /* Handled entries leave the list; removing one unlinks it wherever it is */
+    while (due) {
+        arp_entry_t *entry = due;
+        arp_timer_cancel(entry);
+        if (arp_entry_expire(table, entry, now, retry_ip, retry_port, &retry_count)) {
+            aged_count++;
         }
     }
     
     if (aged_count > 0) {
-        LOG_DEBUG( LOG_CATEGORY_L3, "Aged out %d ARP entries", aged_count);
         table->stats.entries_aged += aged_count;
     }
+
+    /* A resize in progress moves on even when nothing is being added */
+    arp_resize_step(table, ARP_RESIZE_AGE_STEP);
+    ARP_UNLOCK(table);
+
+    for (uint32_t i = 0; i < retry_count; i++) {
+        arp_solicit(table, &retry_ip[i], retry_port[i]);
+    }
+
+    if (aged_count > 0) {
+        LOG_DEBUG( LOG_CATEGORY_L3, "Aged out %d ARP entries", aged_count);
+    }
     
     return STATUS_SUCCESS;
 }
@@ -646,11 +1570,14 @@ status_t arp_get_stats(arp_table_t *table, arp_stats_t *stats) {
         return STATUS_NOT_INITIALIZED;
     }
 
+    ARP_LOCK(table);
+
     /* Update current entry count in stats */
     table->stats.current_entries = table->entry_count;
     
     /* Copy statistics */
     memcpy(stats, &table->stats, sizeof(arp_stats_t));
+    ARP_UNLOCK(table);
     
     return STATUS_SUCCESS;
 }
@@ -675,11 +1602,37 @@ status_t arp_set_timeout(arp_table_t *table, uint32_t timeout_seconds) {
 
     LOG_INFO( LOG_CATEGORY_L3, "Setting ARP cache timeout to %d seconds", timeout_seconds);
     
+    ARP_LOCK(table);
     table->timeout = timeout_seconds;
+
+    /* Reachable neighbors go stale by the new timeout */
+    for (uint32_t i = 0; i < arp_chain_count(table); i++) {
+        for (arp_entry_t *entry = *arp_chain_at(table, i); entry; entry = entry->next) {
+            if (entry->state == ARP_STATE_REACHABLE) {
+                arp_timer_arm(table, entry, entry->updated_time + timeout_seconds);
+            }
+        }
+    }
+    ARP_UNLOCK(table);
     
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Fill the public view of an entry
+ *
+ * @param info Entry information to fill
+ * @param entry ARP entry
+ * @param now Current time (s)
+ */
+static void arp_entry_info_fill(arp_entry_info_t *info, const arp_entry_t *entry, uint32_t now) {
+    memcpy(&info->ip, &entry->ip, sizeof(ipv4_addr_t));
+    memcpy(&info->mac, &entry->mac, sizeof(mac_addr_t));
+    info->port_index = entry->port_index;
+    info->state = arp_state_to_public(entry->state);
+    info->age = now - entry->updated_time;
+}
+
 /**
  * @brief Get all entries in the ARP cache
  *
@@ -702,30 +1655,160 @@ status_t arp_get_all_entries(arp_table_t *table, arp_entry_info_t *entries,
     }
 
     uint16_t count = 0;
+    uint32_t now = get_current_time();
+
+    ARP_LOCK(table);
     
     /* Iterate through all hash buckets */
-    for (int i = 0; i < ARP_CACHE_SIZE && count < max_entries; i++) {
-        arp_entry_t *entry = table->hash_table[i];
+    for (uint32_t i = 0; i < arp_chain_count(table) && count < max_entries; i++) {
+        arp_entry_t *entry = *arp_chain_at(table, i);
         
         while (entry && count < max_entries) {
-            /* Copy entry information */
-            memcpy(&entries[count].ip, &entry->ip, sizeof(ipv4_addr_t));
-            memcpy(&entries[count].mac, &entry->mac, sizeof(mac_addr_t));
-            entries[count].port_index = entry->port_index;
-            entries[count].state = arp_state_to_public(entry->state);
-            entries[count].age = get_current_time() - entry->updated_time;
-            
+            arp_entry_info_fill(&entries[count], entry, now);
             count++;
             entry = entry->next;
         }
     }
     
+    ARP_UNLOCK(table);
     *num_entries = count;
     
     LOG_DEBUG( LOG_CATEGORY_L3, "Retrieved %d ARP entries", count);
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Copy the entries of one chain that fall in a page
+ *
+ * @param entry First entry of the chain
+ * @param n Entries of the walk step so far, advanced past the chain
+ * @param skip Entries of the step the page passes over
+ * @param entries Page, indexed from the first entry not passed over
+ * @param room Entries the page has room for
+ * @param now Current time (s)
+ */
+static void arp_page_chain(const arp_entry_t *entry, uint32_t *n, uint32_t skip,
+                           arp_entry_info_t *entries, uint32_t room, uint32_t now) {
+    for (; entry; entry = entry->next, (*n)++) {
+        if (*n >= skip && *n - skip < room) {
+            arp_entry_info_fill(&entries[*n - skip], entry, now);
+        }
+    }
+}
+
+/**
+ * @brief Copy the chains of one step of a reverse binary walk
+ *
+ * Called with the table lock held. A step is one chain, or while the
+ * buckets are resized, the chain of the old array and the chains of the
+ * new array it splits into.
+ *
+ * @param table Pointer to ARP table structure
+ * @param v Bucket bits of the step
+ * @param skip Entries of the step already returned
+ * @param entries Page, from its first free entry
+ * @param room Entries the page has room for
+ * @param now Current time (s)
+ * @param size Receives the entries of the step
+ * @return uint32_t Bucket bits of the next step, 0 after the last one
+ */
+static uint32_t arp_page_step(arp_table_t *table, uint32_t v, uint32_t skip,
+                              arp_entry_info_t *entries, uint32_t room, uint32_t now, uint32_t *size) {
+    arp_hash_t *old = table->old_hash;
+    uint32_t mask = table->hash->mask;
+    uint32_t n = 0;
+
+    if (old) {
+        arp_page_chain(old->heads[v & old->mask], &n, skip, entries, room, now);
+        do {
+            arp_page_chain(table->hash->heads[v & mask], &n, skip, entries, room, now);
+            v = table_cursor_next(v, mask);
+        } while (v & (old->mask ^ mask));
+    } else {
+        arp_page_chain(table->hash->heads[v & mask], &n, skip, entries, room, now);
+        v = table_cursor_next(v, mask);
+    }
+
+    *size = n;
+    return v;
+}
+
+/**
+ * @brief Get the next page of entries in the ARP cache
+ *
+ * The walk goes in reverse binary order over the bucket bits, as
+ * described in table_cursor.h, so a resize between pages repeats entries
+ * rather than skipping them.
+ *
+ * @param table Pointer to ARP table structure
+ * @param cursor Cursor, moved past the entries returned
+ * @param entries Array to store entries
+ * @param max_entries Size of the array
+ * @param num_entries Pointer to store the actual number of entries retrieved
+ * @return status_t Status code indicating success or failure
+ */
+status_t arp_get_entries_page(arp_table_t *table, table_cursor_t *cursor, arp_entry_info_t *entries,
+                              uint32_t max_entries, uint32_t *num_entries) {
+    if (!table || !cursor || !entries || max_entries == 0 || !num_entries) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameter(s) in arp_get_entries_page");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (!table->initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "ARP module not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    *num_entries = 0;
+    if (*cursor == TABLE_CURSOR_END) {
+        return STATUS_SUCCESS;
+    }
+
+    uint32_t now = get_current_time();
+    uint32_t count = 0;
+    table_cursor_t next;
+
+    ARP_LOCK(table);
+
+    uint32_t mask = table->hash->mask;
+    uint32_t v = table_cursor_bucket(*cursor);
+    uint32_t skip = table_cursor_skip(*cursor, mask);
+
+    /* Whole steps while they fit; a step that fills an empty page alone is split */
+    for (;;) {
+        uint32_t size;
+        uint32_t step = arp_page_step(table, v, skip, &entries[count], max_entries - count, now, &size);
+        uint32_t left = size > skip ? size - skip : 0;
+
+        if (left > max_entries - count) {
+            if (count == 0) {
+                count = max_entries;
+                skip += max_entries;
+            }
+            next = table_cursor_make(v, mask, skip);
+            break;
+        }
+        count += left;
+        skip = 0;
+        if (step == 0) {
+            next = TABLE_CURSOR_END;
+            break;
+        }
+        v = step;
+        if (count == max_entries) {
+            next = table_cursor_make(v, mask, 0);
+            break;
+        }
+    }
+
+    ARP_UNLOCK(table);
+    *cursor = next;
+    *num_entries = count;
+
+    LOG_DEBUG( LOG_CATEGORY_L3, "Retrieved a page of %u ARP entries", count);
+    return STATUS_SUCCESS;
+}
+
 /**
  * @brief Resolve MAC address for a given IP through ARP
  *
@@ -763,10 +1846,8 @@ status_t arp_resolve_next_hop(const ipv4_addr_t *ip_addr, uint16_t port_index, m
     if (status == STATUS_SUCCESS) {
         return STATUS_SUCCESS;
     } else if (status == ARP_STATUS_CACHE_MISS) {
-        // Здесь должен быть код для инициирования ARP-запроса
-        // // шлём ARP-запрос на нужном порту
-        arp_send_request(table, ip_addr, port_index);
-        return ARP_STATUS_PENDING;
+        // шлём ARP-запрос на нужном порту, если он ещё не в пути
+        return arp_resolve_async(ip_addr, port_index);
     }
     
     return status;
@@ -866,7 +1947,18 @@ status_t arp_get_mac_for_ip(const ipv4_addr_t *ip_addr, uint16_t port_index, mac
 //    return arp_send_request(table, target_ip, port_index);
 //}
 
-// Публичная обёртка
+/**
+ * @brief Start resolving an address without waiting for the reply
+ *
+ * Concurrent callers for the same address share one request: while the
+ * neighbor is being resolved or probed, nothing more is sent until aging
+ * retries it. Requests are subject to the global and per-port limits.
+ *
+ * @param target_ip  Адрес, который нужно разрешить
+ * @param port_index Порт, через который шлем ARP-запрос
+ * @return status_t  STATUS_SUCCESS если сосед уже известен, ARP_STATUS_PENDING
+ *                   или иной код ошибки
+ */
 status_t arp_resolve_async(const ipv4_addr_t *target_ip, uint16_t port_index)
 {
     if (!target_ip) {
@@ -889,136 +1981,523 @@ status_t arp_resolve_async(const ipv4_addr_t *target_ip, uint16_t port_index)
               (*target_ip)       & 0xFF,
               port_index);
 
-    return arp_send_request(table, target_ip, port_index);
-}
+    if (!table->initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "ARP module not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    ARP_LOCK(table);
+    arp_entry_t *entry = arp_find_entry(table, target_ip);
+
+    if (entry && (entry->state == ARP_STATE_INCOMPLETE || entry->state == ARP_STATE_PROBE)) {
+        // Запрос уже в пути: повтор выполнит старение
+        table->stats.requests_coalesced++;
+        ARP_UNLOCK(table);
+        return ARP_STATUS_PENDING;
+    }
+
+    if (entry && entry->state != ARP_STATE_FAILED) {
+        ARP_UNLOCK(table);
+        return STATUS_SUCCESS;
+    }
+
+    if (!entry) {
+        entry = arp_allocate_entry(table);
+        if (!entry) {
+            ARP_UNLOCK(table);
+            LOG_ERROR(LOG_CATEGORY_L3, "Failed to allocate new ARP entry for resolution");
+            return STATUS_RESOURCE_EXHAUSTED;
+        }
 
+        memcpy(&entry->ip, target_ip, sizeof(ipv4_addr_t));
+        entry->created_time = get_current_time();
+        entry->state = ARP_STATE_INCOMPLETE;
+        arp_link_entry(table, entry);
+    }
 
+    // Новая попытка после неудачи начинается с нуля
+    entry->port_index = port_index;
+    entry->updated_time = get_current_time();
+    entry->retry_count = 0;
+    arp_set_state(entry, ARP_STATE_INCOMPLETE);
+    bool send_request = arp_request_begin(table, entry, false);
+    ARP_UNLOCK(table);
 
+    if (send_request) {
+        arp_send_request(table, target_ip, port_index);
+    }
 
+    return ARP_STATUS_PENDING;
+}
 
 /**
- * @brief Calculate hash for an IPv4 address
+ * @brief Set how fast ARP requests may be sent
  *
- * @param ipv4 Pointer to IPv4 address
- * @return uint32_t Hash value
+ * @param table Pointer to ARP table structure
+ * @param global_pps Requests per second from the whole switch, 0 for no limit
+ * @param port_pps Requests per second out of each port, 0 for no limit
+ * @param burst Requests either limit lets through back to back, 0 for one
+ *        second worth
+ * @return status_t Status code indicating success or failure
  */
-static uint32_t hash_ipv4(const ipv4_addr_t *ipv4) {
+status_t arp_set_request_rate(arp_table_t *table, uint32_t global_pps, uint32_t port_pps, uint32_t burst) {
+    if (!table) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameter: NULL ARP table pointer");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (!table->initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "ARP module not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    LOG_INFO(LOG_CATEGORY_L3, "Limiting ARP requests to %u/s, %u/s per port, burst %u",
+             global_pps, port_pps, burst);
+
+    ARP_LOCK(table);
+    arp_bucket_set(&table->request_global, global_pps, burst);
+    for (int i = 0; i < CONFIG_MAX_PORTS; i++) {
+        arp_bucket_set(&table->request_port[i], port_pps, burst);
+    }
+    ARP_UNLOCK(table);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the IPv6 Neighbor Discovery cache
+ */
+arp_table_t *nd_table_get_instance(void) {
+    return &g_nd_table;
+}
+
+/**
+ * @brief Initialize an IPv6 Neighbor Discovery cache
+ *
+ * The table is an ARP table keyed by IPv6 address; arp_deinit(),
+ * arp_flush(), arp_age_entries(), arp_get_stats(), arp_set_timeout() and
+ * arp_set_request_rate() work on it unchanged.
+ *
+ * @param table Pointer to the table structure
+ * @return status_t Status code indicating success or failure
+ */
+status_t nd_init(arp_table_t *table) {
+    status_t status = arp_init(table);
+
+    if (status == STATUS_SUCCESS) {
+        table->family = IP_TYPE_V6;
+    }
+    return status;
+}
+
+/**
+ * @brief Check that a table is an initialized ND cache
+ */
+static status_t nd_check_table(const arp_table_t *table) {
+    if (!table) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (!table->initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "ND cache not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (table->family != IP_TYPE_V6) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Table is not an ND cache");
+        return STATUS_INVALID_PARAMETER;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Add or update an IPv6 neighbor
+ *
+ * @param table Pointer to ND table structure
+ * @param ipv6 IPv6 address
+ * @param mac MAC address
+ * @param port_index Port index where the MAC was learned
+ * @return status_t Status code indicating success or failure
+ */
+status_t nd_add_entry(arp_table_t *table, const ipv6_addr_t *ipv6, const mac_addr_t *mac, uint16_t port_index) {
+    status_t status = nd_check_table(table);
+
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    if (!ipv6 || !mac) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameter(s) in nd_add_entry");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    status = arp_learn(table, ipv6, mac, port_index);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    mac_table_add(*mac, port_index, VLAN_ID_DEFAULT, false);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Remove an IPv6 neighbor
+ *
+ * @param table Pointer to ND table structure
+ * @param ipv6 IPv6 address of the neighbor
+ * @return status_t Status code indicating success or failure
+ */
+status_t nd_remove_entry(arp_table_t *table, const ipv6_addr_t *ipv6) {
+    status_t status = nd_check_table(table);
+
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    if (!ipv6) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    return arp_forget(table, ipv6);
+}
+
+/**
+ * @brief Get the prebuilt L2 rewrite of a resolved IPv6 neighbor
+ *
+ * Lock-free, with the same rules as arp_get_rewrite(). Resolution is not
+ * started here: the caller holds the packet with nd_queue_packet(), which
+ * solicits the neighbor.
+ *
+ * @param ip_addr IPv6 address of the neighbor
+ * @param[out] rewrite Rewrite string to copy in front of the L3 header
+ * @return status_t STATUS_SUCCESS, ARP_STATUS_PENDING while the neighbor is
+ *         resolved, ERROR_ENTRY_NOT_FOUND if it is unknown
+ */
+status_t nd_get_rewrite(const ipv6_addr_t *ip_addr, const arp_rewrite_t **rewrite) {
+    arp_table_t *table = &g_nd_table;
+
+    if (!ip_addr || !rewrite) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (!table->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    arp_entry_t *entry = arp_find_entry(table, ip_addr);
+    const arp_rewrite_node_t *node = entry ? __atomic_load_n(&entry->rewrite, __ATOMIC_ACQUIRE) : NULL;
+    if (!node) {
+        return entry ? ARP_STATUS_PENDING : ERROR_ENTRY_NOT_FOUND;
+    }
+
+    arp_note_use(entry);
+    __atomic_fetch_add(&table->stats.cache_hits, 1, __ATOMIC_RELAXED);
+    *rewrite = &node->rewrite;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Hold a packet until its IPv6 next hop is resolved
+ *
+ * @param table Pointer to ND table structure
+ * @param ipv6 IPv6 address of the next hop
+ * @param port_index Port to solicit on if the next hop is unknown
+ * @param packet Packet with the L3 header at offset 0
+ * @return status_t As arp_queue_packet()
+ */
+status_t nd_queue_packet(arp_table_t *table, const ipv6_addr_t *ipv6, uint16_t port_index,
+                         const packet_buffer_t *packet) {
+    status_t status = nd_check_table(table);
+
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    if (!ipv6 || !packet) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameter(s) in nd_queue_packet");
+        return STATUS_INVALID_PARAMETER;
+    }
+    return arp_hold_packet(table, ipv6, port_index, packet);
+}
+
+/**
+ * @brief Learn from a Neighbor Solicitation or Advertisement
+ *
+ * A solicitation teaches the sender's address, an advertisement the
+ * target's, when the message carries the matching link-layer address
+ * option. Messages must come with hop limit 255 and a valid checksum.
+ *
+ * @param packet Packet received on packet->metadata.port
+ * @param l3_offset Offset of the IPv6 header in the packet
+ * @return status_t STATUS_SUCCESS if the packet was a Neighbor Discovery
+ *         message, STATUS_NOT_SUPPORTED for other packets, or another error
+ *         code for malformed ones
+ */
+status_t nd_handle_frame(packet_buffer_t *packet, uint16_t l3_offset) {
+    arp_table_t *table = &g_nd_table;
+
+    if (!packet) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (!table->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if ((uint32_t)l3_offset + sizeof(ipv6_header_t) + offsetof(nd_message_t, opt_type) > packet->size) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    /* The L3 header need not be 4-byte aligned in the frame */
+    ipv6_header_t ip6_header;
+    memcpy(&ip6_header, packet->data + l3_offset, sizeof(ip6_header));
+    const uint8_t *msg = packet->data + l3_offset + sizeof(ipv6_header_t);
+    uint32_t len = ntohs(ip6_header.payload_length);
+
+    if (ip6_header.next_header != IP_PROTO_ICMPV6 ||
+        (msg[0] != ND_TYPE_NEIGHBOR_SOLICIT && msg[0] != ND_TYPE_NEIGHBOR_ADVERT)) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    if (ip6_header.hop_limit != ND_HOP_LIMIT || msg[1] != 0 ||
+        len < offsetof(nd_message_t, opt_type) ||
+        (uint32_t)l3_offset + sizeof(ipv6_header_t) + len > packet->size ||
+        nd_checksum(&ip6_header.src_addr, &ip6_header.dst_addr, msg, len) != 0) {
+        LOG_WARNING(LOG_CATEGORY_L3, "Invalid Neighbor Discovery message");
+        __atomic_fetch_add(&table->stats.invalid_packets, 1, __ATOMIC_RELAXED);
+        return STATUS_INVALID_PACKET;
+    }
+
+    bool solicit = msg[0] == ND_TYPE_NEIGHBOR_SOLICIT;
+    uint8_t wanted = solicit ? ND_OPT_SOURCE_LLADDR : ND_OPT_TARGET_LLADDR;
+    const mac_addr_t *lladdr = NULL;
+    static const ipv6_addr_t unspecified;
+
+    /* Options in units of 8 bytes, the first at the option field of nd_message_t */
+    for (uint32_t off = offsetof(nd_message_t, opt_type); off + 2 <= len; ) {
+        uint32_t opt_len = msg[off + 1] * 8U;
+        if (opt_len == 0 || off + opt_len > len) {
+            __atomic_fetch_add(&table->stats.invalid_packets, 1, __ATOMIC_RELAXED);
+            return STATUS_INVALID_PACKET;
+        }
+        if (msg[off] == wanted && opt_len >= 2 + MAC_ADDR_LEN) {
+            lladdr = (const mac_addr_t *)(msg + off + 2);
+        }
+        off += opt_len;
+    }
+
+    if (solicit) {
+        __atomic_fetch_add(&table->stats.requests_received, 1, __ATOMIC_RELAXED);
+        /* Duplicate address detection comes from the unspecified address */
+        if (lladdr && memcmp(&ip6_header.src_addr, &unspecified, sizeof(ipv6_addr_t)) != 0) {
+            ipv6_addr_t sender = ip6_header.src_addr;
+            arp_learn(table, &sender, lladdr, packet->metadata.port);
+        }
+    } else {
+        __atomic_fetch_add(&table->stats.replies_received, 1, __ATOMIC_RELAXED);
+        if (lladdr) {
+            ipv6_addr_t target;
+            memcpy(&target, msg + offsetof(nd_message_t, target), sizeof(target));
+            arp_learn(table, &target, lladdr, packet->metadata.port);
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+
+
+
+
+/**
+ * @brief Calculate hash for an IPv4 address
+ *
+ * @param ipv4 Pointer to IPv4 address
+ * @return uint32_t Hash value
+ */
+static uint32_t hash_ipv4(const ipv4_addr_t *ipv4) {
     uint32_t ip_value;
     memcpy(&ip_value, ipv4, sizeof(ipv4_addr_t));
     
-    /* A simple hash function based on multiplication and XOR */
-    uint32_t hash = ip_value;
-    hash = ((hash >> 16) ^ hash) * 0x45d9f3b;
-    hash = ((hash >> 16) ^ hash) * 0x45d9f3b;
-    hash = (hash >> 16) ^ hash;
-    
-    return hash;
+    /* Keyed, so senders cannot pick addresses that share a chain */
+    return (uint32_t)keyed_hash_u64(ip_value);
+}
+
+/**
+ * @brief Size of the addresses a table is keyed by
+ */
+static inline size_t arp_addr_len(const arp_table_t *table) {
+    return table->family == IP_TYPE_V6 ? sizeof(ipv6_addr_t) : sizeof(ipv4_addr_t);
+}
+
+/**
+ * @brief Hash function for neighbor addresses of either family
+ *
+ * @param table Table whose family the address has
+ * @param addr Address to hash
+ * @return uint32_t Hash value
+ */
+static uint32_t arp_hash_addr(const arp_table_t *table, const void *addr) {
+    if (table->family != IP_TYPE_V6) {
+        return hash_ipv4((const ipv4_addr_t *)addr);
+    }
+
+    return (uint32_t)keyed_hash_bytes(addr, sizeof(ipv6_addr_t));
 }
 
 /**
  * @brief Find an entry in the ARP cache
  *
+ * Safe without the table lock inside an RCU read section: links are
+ * loaded with acquire semantics and unlinked entries stay intact until
+ * the grace period ends.
+ *
  * @param table Pointer to ARP table structure
- * @param ipv4 IPv4 address to find
+ * @param addr Address of the table's family to find
  * @return arp_entry_t* Pointer to the entry if found, NULL otherwise
  */
-static arp_entry_t *arp_find_entry(arp_table_t *table, const ipv4_addr_t *ipv4) {
-    uint32_t hash = hash_ipv4(ipv4) % ARP_CACHE_SIZE;
-    arp_entry_t *entry = table->hash_table[hash];
-    
-    while (entry) {
-        if (memcmp(&entry->ip, ipv4, sizeof(ipv4_addr_t)) == 0) {
-            return entry;
+static arp_entry_t *arp_find_entry(arp_table_t *table, const void *addr) {
+    uint32_t hash = arp_hash_addr(table, addr);
+    size_t len = arp_addr_len(table);
+    arp_entry_t *entry;
+    uint32_t seq;
+
+    /* While resizing, an address not yet found in the new buckets may still
+     * be in the old ones; a walk that raced with a migration step is redone */
+    do {
+        while ((seq = __atomic_load_n(&table->resize_seq, __ATOMIC_ACQUIRE)) & 1) {
+            cpu_relax();
         }
-        entry = entry->next;
-    }
-    
-    return NULL;
+
+        arp_hash_t *buckets = __atomic_load_n(&table->hash, __ATOMIC_ACQUIRE);
+        arp_hash_t *old = __atomic_load_n(&table->old_hash, __ATOMIC_ACQUIRE);
+
+        entry = __atomic_load_n(&buckets->heads[hash & buckets->mask], __ATOMIC_ACQUIRE);
+        while (entry && memcmp(&entry->addr, addr, len) != 0) {
+            entry = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE);
+        }
+        if (!entry && old) {
+            entry = __atomic_load_n(&old->heads[hash & old->mask], __ATOMIC_ACQUIRE);
+            while (entry && memcmp(&entry->addr, addr, len) != 0) {
+                entry = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE);
+            }
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&table->resize_seq, __ATOMIC_RELAXED) != seq);
+
+    return entry;
 }
 
 /**
  * @brief Allocate a new ARP entry from the pool
  *
+ * Called with the table lock held. When the cache is full its limit is
+ * doubled, up to ARP_GROW_MAX; past that the oldest entry is evicted. It
+ * becomes reusable after a grace period, meanwhile the spare pool entries
+ * are handed out.
+ *
  * @param table Pointer to ARP table structure
  * @return arp_entry_t* Pointer to the allocated entry, NULL if pool is exhausted
  */
 static arp_entry_t *arp_allocate_entry(arp_table_t *table) {
+    /* A full cache grows while it may */
+    if (table->entry_count >= table->max_entries && table->max_entries < ARP_GROW_MAX) {
+        table->max_entries = table->max_entries < ARP_GROW_MAX / 2 ? table->max_entries * 2 : ARP_GROW_MAX;
+        LOG_INFO(LOG_CATEGORY_L3, "ARP cache grown to %u entries", table->max_entries);
+    }
+
     /* If we've reached the maximum number of entries, recycle the oldest one */
-    if (table->entry_count >= ARP_CACHE_SIZE) {
+    if (table->entry_count >= table->max_entries) {
         uint32_t oldest_time = UINT32_MAX;
         arp_entry_t *oldest_entry = NULL;
-        int oldest_bucket = -1;
-        arp_entry_t *oldest_prev = NULL;
+        arp_entry_t **oldest_link = NULL;
         
         /* Find the oldest entry */
-        for (int i = 0; i < ARP_CACHE_SIZE; i++) {
-            arp_entry_t *entry = table->hash_table[i];
-            arp_entry_t *prev = NULL;
+        for (uint32_t i = 0; i < arp_chain_count(table); i++) {
+            arp_entry_t **link = arp_chain_at(table, i);
+            arp_entry_t *entry = *link;
             
             while (entry) {
                 if (entry->updated_time < oldest_time) {
                     oldest_time = entry->updated_time;
                     oldest_entry = entry;
-                    oldest_bucket = i;
-                    oldest_prev = prev;
+                    oldest_link = link;
                 }
                 
-                prev = entry;
+                link = &entry->next;
                 entry = entry->next;
             }
         }
         
         /* Remove the oldest entry from its hash chain */
         if (oldest_entry) {
-            if (oldest_prev) {
-                oldest_prev->next = oldest_entry->next;
-            } else {
-                table->hash_table[oldest_bucket] = oldest_entry->next;
-            }
-            
-            /* Clear the entry for reuse */
-            memset(oldest_entry, 0, sizeof(arp_entry_t));
-            table->entry_count--; /* Will be incremented again when entry is added */
-            
-            return oldest_entry;
+            arp_unlink_entry(table, oldest_link, oldest_entry);
         }
-        
-        /* If we couldn't find an entry to recycle, fail */
-        LOG_ERROR(LOG_CATEGORY_L3, "Failed to allocate ARP entry: cache full and no entry available for recycling");
-        return NULL;
     }
     
-    /* Allocate a new entry from the pool */
-    for (int i = 0; i < ARP_CACHE_SIZE; i++) {
-        arp_entry_t *entry = &table->entry_pool[i];
-        
-        /* Find a free entry (not linked in any hash bucket) */
-        bool is_used = false;
-        for (int j = 0; j < ARP_CACHE_SIZE; j++) {
-            arp_entry_t *bucket_entry = table->hash_table[j];
-            
-            while (bucket_entry) {
-                if (bucket_entry == entry) {
-                    is_used = true;
-                    break;
-                }
-                bucket_entry = bucket_entry->next;
-            }
-            
-            if (is_used) {
-                break;
-            }
-        }
-        
-        if (!is_used) {
-            /* Found a free entry */
-            memset(entry, 0, sizeof(arp_entry_t));
-            return entry;
+    /* Take an entry from the free list; only writers pop, under the lock */
+    arp_entry_t *entry;
+    do {
+        entry = __atomic_load_n(&table->free_list, __ATOMIC_ACQUIRE);
+        while (entry && !__atomic_compare_exchange_n(&table->free_list, &entry, entry->free_next, false,
+                                                     __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
         }
+    } while (!entry && arp_pool_grow(table));
+    
+    if (!entry) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to allocate ARP entry: all entries in use");
+        return NULL;
     }
     
-    LOG_ERROR(LOG_CATEGORY_L3, "Failed to allocate ARP entry: all entries in use");
-    return NULL;
+    entry->free_next = NULL;
+    return entry;
+}
+
+/**
+ * @brief Add a chunk of entries to the pool
+ *
+ * Called with the table lock held, or before the table is shared. The
+ * chunk's entries are pushed onto the free list in one compare-and-swap.
+ *
+ * @param table Pointer to ARP table structure
+ * @return bool false if the pool is at max_entries + ARP_RETIRE_SLACK or
+ *         memory ran out
+ */
+static bool arp_pool_grow(arp_table_t *table) {
+    if (table->pool_size >= table->max_entries + ARP_RETIRE_SLACK) {
+        return false;
+    }
+
+    arp_pool_chunk_t *chunk = (arp_pool_chunk_t *)mem_arena_alloc(mem_arena_get(ARP_POOL_ARENA),
+                                                                  sizeof(arp_pool_chunk_t), 0);
+    if (!chunk) {
+        return false;
+    }
+
+    for (int i = 0; i < ARP_POOL_CHUNK; i++) {
+        chunk->entries[i].table = table;
+        chunk->entries[i].free_next = i + 1 < ARP_POOL_CHUNK ? &chunk->entries[i + 1] : NULL;
+    }
+
+    arp_entry_t *last = &chunk->entries[ARP_POOL_CHUNK - 1];
+    last->free_next = __atomic_load_n(&table->free_list, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&table->free_list, &last->free_next, &chunk->entries[0], true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+
+    chunk->next = table->entry_pool;
+    table->entry_pool = chunk;
+    table->pool_size += ARP_POOL_CHUNK;
+    return true;
+}
+
+/**
+ * @brief Return a retired ARP entry to the pool
+ *
+ * Runs once no reader can still reach the entry. It may run on any thread,
+ * so the free list is pushed with a compare-and-swap rather than the lock.
+ *
+ * @param head RCU header of the entry
+ */
+static void arp_entry_reclaim(rcu_head_t *head) {
+    arp_entry_t *entry = (arp_entry_t *)((char *)head - offsetof(arp_entry_t, rcu));
+
+    arp_free_entry(entry->table, entry);
 }
 
 /**
@@ -1028,10 +2507,276 @@ static arp_entry_t *arp_allocate_entry(arp_table_t *table) {
  * @param entry Pointer to the entry to free
  */
 static void arp_free_entry(arp_table_t *table, arp_entry_t *entry) {
+    /* The rewrite went away with the entry */
+    mem_free(MEM_TAG_ARP, entry->rewrite);
+
     /* Clear the entry */
     memset(entry, 0, sizeof(arp_entry_t));
-    /* Note: We don't need to do anything else since the entry is already
-     * removed from its hash chain by the caller */
+    entry->table = table;
+
+    entry->free_next = __atomic_load_n(&table->free_list, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&table->free_list, &entry->free_next, entry, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+ * @brief Publish an entry at the head of its hash chain
+ *
+ * Called with the table lock held, once the entry is fully set up.
+ *
+ * @param table Pointer to ARP table structure
+ * @param entry Entry to add
+ */
+static void arp_link_entry(arp_table_t *table, arp_entry_t *entry) {
+    arp_entry_t **head = arp_chain(table, arp_hash_addr(table, &entry->addr));
+
+    entry->next = *head;
+    __atomic_store_n(head, entry, __ATOMIC_RELEASE);
+    table->entry_count++;
+    arp_resize_step(table, ARP_RESIZE_STEP);
+}
+
+/**
+ * @brief Allocate an empty bucket array
+ *
+ * @param buckets Number of buckets, a power of two
+ * @return arp_hash_t* New array, NULL if memory ran out
+ */
+static arp_hash_t *arp_hash_alloc(uint32_t buckets) {
+    arp_hash_t *hash = (arp_hash_t *)mem_arena_alloc(mem_arena_get(ARP_POOL_ARENA),
+                                                     sizeof(arp_hash_t) + buckets * sizeof(arp_entry_t *), 0);
+
+    if (hash) {
+        hash->mask = buckets - 1;
+    }
+    return hash;
+}
+
+/**
+ * @brief Free a bucket array
+ *
+ * @param hash Array, may be NULL
+ */
+static void arp_hash_free(arp_hash_t *hash) {
+    if (hash) {
+        mem_arena_free(mem_arena_get(ARP_POOL_ARENA), hash,
+                       sizeof(arp_hash_t) + (hash->mask + 1) * sizeof(arp_entry_t *));
+    }
+}
+
+/**
+ * @brief Free a migrated bucket array once no reader can still walk it
+ *
+ * @param head RCU header of the array
+ */
+static void arp_hash_reclaim(rcu_head_t *head) {
+    arp_hash_free((arp_hash_t *)((char *)head - offsetof(arp_hash_t, rcu)));
+}
+
+/**
+ * @brief Head of the chain an address belongs to
+ *
+ * Called with the table lock held. While resizing, buckets of the old
+ * array that were not migrated yet still hold their chains.
+ *
+ * @param table Pointer to ARP table structure
+ * @param hash Hash of the address
+ * @return arp_entry_t** Link that points at the first entry of the chain
+ */
+static arp_entry_t **arp_chain(arp_table_t *table, uint32_t hash) {
+    arp_hash_t *old = table->old_hash;
+
+    if (old && (hash & old->mask) >= table->migrated) {
+        return &old->heads[hash & old->mask];
+    }
+    return &table->hash->heads[hash & table->hash->mask];
+}
+
+/**
+ * @brief Number of chains to visit for a walk over the whole table
+ *
+ * Called with the table lock held; the old array's chains come first.
+ */
+static uint32_t arp_chain_count(const arp_table_t *table) {
+    return (table->old_hash ? table->old_hash->mask + 1 : 0) + table->hash->mask + 1;
+}
+
+/**
+ * @brief Head of chain number index of a walk over the whole table
+ */
+static arp_entry_t **arp_chain_at(arp_table_t *table, uint32_t index) {
+    if (table->old_hash) {
+        if (index <= table->old_hash->mask) {
+            return &table->old_hash->heads[index];
+        }
+        index -= table->old_hash->mask + 1;
+    }
+    return &table->hash->heads[index];
+}
+
+/**
+ * @brief Start or continue a resize of the buckets
+ *
+ * Called with the table lock held. Once the cache holds more than
+ * ARP_HASH_LOAD entries per bucket, an array twice the size is published
+ * and new entries go to it; every step then moves the chains of a few old
+ * buckets over. Readers look in both arrays meanwhile, and resize_seq is
+ * odd while a chain is being moved, so a walk that could have been led
+ * astray by a moved link is redone. The old array is retired once empty.
+ *
+ * @param table Pointer to ARP table structure
+ * @param steps Old buckets to migrate at most
+ */
+static void arp_resize_step(arp_table_t *table, uint32_t steps) {
+    arp_hash_t *old = table->old_hash;
+
+    if (!old) {
+        uint32_t buckets = table->hash->mask + 1;
+
+        if (table->entry_count <= buckets * ARP_HASH_LOAD) {
+            return;
+        }
+
+        arp_hash_t *grown = arp_hash_alloc(buckets * 2);
+        if (!grown) {
+            return;
+        }
+
+        /* Readers that see the new array also see the old one */
+        old = table->hash;
+        table->migrated = 0;
+        __atomic_store_n(&table->old_hash, old, __ATOMIC_RELEASE);
+        __atomic_store_n(&table->hash, grown, __ATOMIC_RELEASE);
+        LOG_INFO(LOG_CATEGORY_L3, "Resizing %s cache from %u to %u buckets",
+                 table->family == IP_TYPE_V6 ? "ND" : "ARP", buckets, buckets * 2);
+    }
+
+    for (; steps > 0 && table->migrated <= old->mask; steps--, table->migrated++) {
+        arp_entry_t *entry = old->heads[table->migrated];
+
+        if (!entry) {
+            continue;
+        }
+
+        __atomic_store_n(&table->resize_seq, table->resize_seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        __atomic_store_n(&old->heads[table->migrated], NULL, __ATOMIC_RELAXED);
+        while (entry) {
+            arp_entry_t *next = entry->next;
+            arp_entry_t **head = &table->hash->heads[arp_hash_addr(table, &entry->addr) & table->hash->mask];
+
+            __atomic_store_n(&entry->next, *head, __ATOMIC_RELAXED);
+            __atomic_store_n(head, entry, __ATOMIC_RELAXED);
+            entry = next;
+        }
+        __atomic_store_n(&table->resize_seq, table->resize_seq + 1, __ATOMIC_RELEASE);
+    }
+
+    if (table->migrated > old->mask) {
+        __atomic_store_n(&table->old_hash, NULL, __ATOMIC_RELEASE);
+        rcu_retire(&old->rcu, arp_hash_reclaim);
+    }
+}
+
+/**
+ * @brief Unlink an entry and retire it
+ *
+ * Called with the table lock held. Readers already on the entry keep
+ * following its next link; it returns to the pool after a grace period.
+ *
+ * @param table Pointer to ARP table structure
+ * @param link Link that points at the entry
+ * @param entry Entry to remove
+ */
+static void arp_unlink_entry(arp_table_t *table, arp_entry_t **link, arp_entry_t *entry) {
+    arp_drop_pending(table, entry);
+    arp_timer_cancel(entry);
+    __atomic_store_n(link, entry->next, __ATOMIC_RELEASE);
+    table->entry_count--;
+    __atomic_add_fetch(&g_arp_generation, 1, __ATOMIC_RELEASE);
+    rcu_retire(&entry->rcu, arp_entry_reclaim);
+}
+
+/**
+ * @brief Unlink and retire an entry found other than by walking its chain
+ *
+ * Called with the table lock held.
+ *
+ * @param table Pointer to ARP table structure
+ * @param entry Entry to remove
+ */
+static void arp_remove_locked(arp_table_t *table, arp_entry_t *entry) {
+    arp_entry_t **link = arp_chain(table, arp_hash_addr(table, &entry->addr));
+
+    while (*link && *link != entry) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        arp_unlink_entry(table, link, entry);
+    }
+}
+
+/**
+ * @brief Free a replaced rewrite string
+ *
+ * @param head RCU header of the rewrite
+ */
+static void arp_rewrite_free(rcu_head_t *head) {
+    mem_free(MEM_TAG_ARP, (char *)head - offsetof(arp_rewrite_node_t, rcu));
+}
+
+/**
+ * @brief Build and publish the L2 rewrite of a resolved entry
+ *
+ * The rewrite is dst MAC, the egress port's MAC, an 802.1Q tag when the
+ * entry has a VLAN, and the ethertype of the table's family. The previous rewrite is
+ * retired; if no memory is left it stays published. Called with the table
+ * lock held.
+ *
+ * @param entry Resolved entry
+ */
+static void arp_publish_rewrite(arp_entry_t *entry) {
+    arp_rewrite_node_t *node = (arp_rewrite_node_t *)mem_malloc(MEM_TAG_ARP, sizeof(arp_rewrite_node_t));
+    arp_rewrite_node_t *old;
+    mac_addr_t port_mac;
+    uint8_t *bytes;
+    uint16_t field;
+
+    if (!node) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to allocate ARP rewrite string");
+        return;
+    }
+
+    memset(node, 0, sizeof(*node));
+    if (port_get_mac(entry->port_index, &port_mac) != STATUS_SUCCESS) {
+        memset(&port_mac, 0, sizeof(port_mac));
+    }
+
+    bytes = node->rewrite.bytes;
+    memcpy(bytes, entry->mac.addr, MAC_ADDR_LEN);
+    bytes += MAC_ADDR_LEN;
+    memcpy(bytes, port_mac.addr, MAC_ADDR_LEN);
+    bytes += MAC_ADDR_LEN;
+    if (entry->vlan_id != 0) {
+        field = htons(ETHERTYPE_VLAN);
+        memcpy(bytes, &field, sizeof(field));
+        field = htons(entry->vlan_id);
+        memcpy(bytes + sizeof(field), &field, sizeof(field));
+        bytes += 2 * sizeof(field);
+    }
+    field = htons(entry->table->family == IP_TYPE_V6 ? ETHERTYPE_IPV6 : ETHERTYPE_IP);
+    memcpy(bytes, &field, sizeof(field));
+    bytes += sizeof(field);
+
+    node->rewrite.len = (uint8_t)(bytes - node->rewrite.bytes);
+    node->rewrite.port_index = entry->port_index;
+
+    old = __atomic_exchange_n(&entry->rewrite, node, __ATOMIC_ACQ_REL);
+    __atomic_add_fetch(&g_arp_generation, 1, __ATOMIC_RELEASE);
+    if (old) {
+        rcu_retire(&old->rcu, arp_rewrite_free);
+    }
 }
 
 /**
@@ -1119,6 +2864,144 @@ static status_t arp_send_request(arp_table_t *table, const ipv4_addr_t *target_i
     return status;
 }
 
+/**
+ * @brief Ask for the link-layer address of a neighbor of either family
+ *
+ * @param table Pointer to ARP or ND table structure
+ * @param addr Address of the table's family
+ * @param port_index Port index to send the request on
+ * @return status_t Status code indicating success or failure
+ */
+static status_t arp_solicit(arp_table_t *table, const void *addr, uint16_t port_index) {
+    if (table->family == IP_TYPE_V6) {
+        return nd_send_solicit(table, (const ipv6_addr_t *)addr, port_index);
+    }
+    return arp_send_request(table, (const ipv4_addr_t *)addr, port_index);
+}
+
+/**
+ * @brief ICMPv6 checksum of a message
+ *
+ * @param src Source address of the IPv6 header
+ * @param dst Destination address of the IPv6 header
+ * @param msg ICMPv6 message
+ * @param len Length of msg
+ * @return uint16_t Checksum in host order; 0 when verifying a valid message
+ */
+static uint16_t nd_checksum(const ipv6_addr_t *src, const ipv6_addr_t *dst, const void *msg, uint32_t len) {
+    const uint8_t *bytes = (const uint8_t *)msg;
+    uint32_t sum = 0;
+
+    /* Pseudo-header: addresses, upper-layer length and next header */
+    for (int i = 0; i < 16; i += 2) {
+        sum += (uint32_t)(src->addr[i] << 8 | src->addr[i + 1]);
+        sum += (uint32_t)(dst->addr[i] << 8 | dst->addr[i + 1]);
+    }
+    sum += (len >> 16) + (len & 0xFFFF) + IP_PROTO_ICMPV6;
+
+    for (uint32_t i = 0; i + 1 < len; i += 2) {
+        sum += (uint32_t)(bytes[i] << 8 | bytes[i + 1]);
+    }
+    if (len & 1) {
+        sum += (uint32_t)bytes[len - 1] << 8;
+    }
+
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+/**
+ * @brief Send a Neighbor Solicitation
+ *
+ * The solicitation goes to the target's solicited-node multicast group
+ * from the egress port's EUI-64 link-local address and carries the port's
+ * MAC as source link-layer address option.
+ *
+ * @param table Pointer to ND table structure
+ * @param target_ip Target IPv6 address to resolve
+ * @param port_index Port index to send the solicitation on
+ * @return status_t Status code indicating success or failure
+ */
+static status_t nd_send_solicit(arp_table_t *table, const ipv6_addr_t *target_ip, uint16_t port_index) {
+    if (!table || !target_ip) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameter(s) in nd_send_solicit");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    LOG_DEBUG(LOG_CATEGORY_L3, "Sending Neighbor Solicitation on port %d", port_index);
+
+    mac_addr_t our_mac;
+    if (port_get_mac(port_index, &our_mac) != STATUS_SUCCESS) {
+        memset(&our_mac, 0, sizeof(our_mac));
+    }
+
+    /* Ethernet header to the group's 33:33:ff:xx:xx:xx address */
+    ethernet_header_t eth_header;
+    const uint8_t group_mac[MAC_ADDR_LEN] = { 0x33, 0x33, 0xFF, target_ip->addr[13],
+                                              target_ip->addr[14], target_ip->addr[15] };
+    memcpy(eth_header.dst_mac.addr, group_mac, MAC_ADDR_LEN);
+    memcpy(&eth_header.src_mac, &our_mac, sizeof(mac_addr_t));
+    eth_header.ethertype = htons(ETHERTYPE_IPV6);
+
+    /* IPv6 header from fe80::EUI-64 to ff02::1:ffxx:xxxx */
+    ipv6_header_t ip6_header;
+    memset(&ip6_header, 0, sizeof(ip6_header));
+    ip6_header.version_class_flow = htonl(6U << 28);
+    ip6_header.payload_length = htons(sizeof(nd_message_t));
+    ip6_header.next_header = IP_PROTO_ICMPV6;
+    ip6_header.hop_limit = ND_HOP_LIMIT;
+    ip6_header.src_addr.addr[0] = 0xFE;
+    ip6_header.src_addr.addr[1] = 0x80;
+    ip6_header.src_addr.addr[8] = our_mac.addr[0] ^ 0x02;
+    ip6_header.src_addr.addr[9] = our_mac.addr[1];
+    ip6_header.src_addr.addr[10] = our_mac.addr[2];
+    ip6_header.src_addr.addr[11] = 0xFF;
+    ip6_header.src_addr.addr[12] = 0xFE;
+    memcpy(&ip6_header.src_addr.addr[13], &our_mac.addr[3], 3);
+    ip6_header.dst_addr.addr[0] = 0xFF;
+    ip6_header.dst_addr.addr[1] = 0x02;
+    ip6_header.dst_addr.addr[11] = 0x01;
+    ip6_header.dst_addr.addr[12] = 0xFF;
+    memcpy(&ip6_header.dst_addr.addr[13], &target_ip->addr[13], 3);
+
+    /* Solicitation with our MAC as source link-layer address */
+    nd_message_t ns;
+    memset(&ns, 0, sizeof(ns));
+    ns.type = ND_TYPE_NEIGHBOR_SOLICIT;
+    memcpy(&ns.target, target_ip, sizeof(ipv6_addr_t));
+    ns.opt_type = ND_OPT_SOURCE_LLADDR;
+    ns.opt_len = 1;
+    memcpy(&ns.lladdr, &our_mac, sizeof(mac_addr_t));
+    ns.checksum = htons(nd_checksum(&ip6_header.src_addr, &ip6_header.dst_addr, &ns, sizeof(ns)));
+
+    const uint32_t total_size = sizeof(ethernet_header_t) + sizeof(ipv6_header_t) + sizeof(nd_message_t);
+    packet_buffer_t *packet = packet_buffer_alloc(total_size);
+    if (!packet) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to allocate packet buffer for Neighbor Solicitation");
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    memcpy(packet->data, &eth_header, sizeof(ethernet_header_t));
+    memcpy(packet->data + sizeof(ethernet_header_t), &ip6_header, sizeof(ipv6_header_t));
+    memcpy(packet->data + sizeof(ethernet_header_t) + sizeof(ipv6_header_t), &ns, sizeof(ns));
+    packet->size = total_size;
+
+    packet->metadata.port = port_index;
+    packet->metadata.direction = PACKET_DIR_TX;
+    packet->metadata.timestamp = 0;
+
+    status_t status = packet_transmit(packet, port_index);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to transmit Neighbor Solicitation: %s",
+                  error_to_string(status));
+    }
+
+    packet_buffer_free(packet);
+    return status;
+}
+
 /**
  * @brief Send an ARP reply packet
  *
@@ -1197,13 +3080,244 @@ static status_t arp_send_reply(arp_table_t *table, const ipv4_addr_t *target_ip,
 
 
 /**
- * @brief Get current system time in seconds
+ * @brief Drop the packets an entry holds for resolution
+ *
+ * Called with the table lock held when the entry fails or goes away.
+ *
+ * @param table Pointer to ARP table structure
+ * @param entry Entry whose packets are dropped
+ */
+static void arp_drop_pending(arp_table_t *table, arp_entry_t *entry) {
+    for (uint8_t i = 0; i < entry->pending_count; i++) {
+        packet_buffer_free(entry->pending[i]);
+        entry->pending[i] = NULL;
+    }
+    table->stats.pending_dropped += entry->pending_count;
+    entry->pending_count = 0;
+}
+
+/**
+ * @brief Send the packets that waited for a neighbor in one burst
+ *
+ * Each packet gets the neighbor's rewrite in front of its L3 header and
+ * the burst is queued on the egress port's TX ring, which takes ownership.
+ * Packets the ring has no room for are dropped. Called without the lock.
+ *
+ * @param table Pointer to ARP table structure
+ * @param rewrite Rewrite of the resolved neighbor
+ * @param pkts Packets to send, owned by the caller until queued
+ * @param count Number of packets
+ */
+static void arp_send_pending(arp_table_t *table, const arp_rewrite_t *rewrite,
+                             packet_buffer_t **pkts, uint32_t count) {
+    packet_buffer_t *ready[ARP_PENDING_MAX];
+    uint32_t ready_count = 0;
+    uint32_t sent;
+    uint8_t *l2_header;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (packet_push_header(pkts[i], rewrite->len, &l2_header) == STATUS_SUCCESS) {
+            memcpy(l2_header, rewrite->bytes, rewrite->len);
+            ready[ready_count++] = pkts[i];
+        } else {
+            packet_buffer_free(pkts[i]);
+        }
+    }
+
+    sent = ready_count ? hw_sim_tx_enqueue_burst(rewrite->port_index, ready, ready_count) : 0;
+    for (uint32_t i = sent; i < ready_count; i++) {
+        packet_buffer_free(ready[i]);
+    }
+
+    __atomic_fetch_add(&table->stats.pending_sent, sent, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&table->stats.pending_dropped, count - sent, __ATOMIC_RELAXED);
+
+    LOG_DEBUG(LOG_CATEGORY_L3, "Sent %u packets held for ARP resolution on port %u",
+              sent, rewrite->port_index);
+}
+
+/**
+ * @brief Program a request bucket
+ *
+ * @param bucket Bucket to program
+ * @param rate Requests per second, 0 for no limit
+ * @param burst Requests allowed back to back, 0 for one second worth
+ */
+static void arp_bucket_set(arp_bucket_t *bucket, uint32_t rate, uint32_t burst) {
+    bucket->tat = 0;
+    bucket->interval_ns = rate ? ARP_NS_PER_SEC / rate : 0;
+    bucket->depth_ns = (uint64_t)(burst ? burst : rate) * bucket->interval_ns;
+}
+
+/**
+ * @brief Take one request from a bucket
+ *
+ * @param bucket Bucket to charge
+ * @param now Current time (ns)
+ * @return true if the request conforms
+ */
+static bool arp_bucket_take(arp_bucket_t *bucket, uint64_t now) {
+    if (bucket->interval_ns == 0) {
+        return true;
+    }
+
+    uint64_t next = (bucket->tat > now ? bucket->tat : now) + bucket->interval_ns;
+    if (next - now > bucket->depth_ns) {
+        return false;
+    }
+    bucket->tat = next;
+    return true;
+}
+
+/**
+ * @brief Decide whether a request for an entry may go out now
+ *
+ * Called with the table lock held. An admitted request is charged to the
+ * port's and the global bucket and arms the entry's retry timer, each
+ * retry waiting twice as long as the one before. A throttled request
+ * leaves the timer a second away, so the next aging pass tries again.
+ *
+ * @param table Pointer to ARP table structure
+ * @param entry Entry the request resolves
+ * @param retry Whether the request repeats an unanswered one
+ * @return true if the caller should send the request once the lock is dropped
+ */
+static bool arp_request_begin(arp_table_t *table, arp_entry_t *entry, bool retry) {
+    uint64_t now = arp_now_ns();
+    uint32_t now_sec = (uint32_t)(now / ARP_NS_PER_SEC);
+    arp_bucket_t *port = entry->port_index < CONFIG_MAX_PORTS ?
+        &table->request_port[entry->port_index] : NULL;
+    uint64_t port_tat = port ? port->tat : 0;
+
+    if ((port && !arp_bucket_take(port, now)) || !arp_bucket_take(&table->request_global, now)) {
+        /* A port denied by the global limit gets its token back */
+        if (port) {
+            port->tat = port_tat;
+        }
+        arp_timer_arm(table, entry, now_sec + 1);
+        table->stats.requests_throttled++;
+        return false;
+    }
+
+    if (retry) {
+        entry->retry_count++;
+    }
+    uint8_t shift = entry->retry_count < ARP_REQUEST_BACKOFF_MAX ?
+        entry->retry_count : ARP_REQUEST_BACKOFF_MAX;
+    uint32_t interval = (uint32_t)((ARP_REQUEST_RETRY_INTERVAL_MS << shift) / 1000);
+    arp_timer_arm(table, entry, now_sec + (interval ? interval : 1));
+    entry->updated_time = now_sec;
+    table->stats.requests_sent++;
+    return true;
+}
+
+/**
+ * @brief Note that a resolved entry was forwarded to
+ *
+ * Runs on forwarding threads without the lock; only stale entries are
+ * written, so busy neighbors do not bounce the entry's cache line.
+ *
+ * @param entry Entry the packet is sent to
+ */
+static inline void arp_note_use(arp_entry_t *entry) {
+    if (__atomic_load_n(&entry->state, __ATOMIC_RELAXED) == ARP_STATE_STALE &&
+        !__atomic_load_n(&entry->used, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&entry->used, true, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Put an entry at the head of a wheel slot
+ *
+ * @param slot Slot or list to add to
+ * @param entry Entry whose timer is not armed
+ */
+static void arp_timer_push(arp_entry_t **slot, arp_entry_t *entry) {
+    entry->timer_next = *slot;
+    if (*slot) {
+        (*slot)->timer_pprev = &entry->timer_next;
+    }
+    *slot = entry;
+    entry->timer_pprev = slot;
+}
+
+/**
+ * @brief Move every entry of a wheel slot onto a list, emptying the slot
+ *
+ * @param to List to add to
+ * @param from Slot to empty
+ */
+static void arp_timer_splice(arp_entry_t **to, arp_entry_t **from) {
+    while (*from) {
+        arp_entry_t *entry = *from;
+        arp_timer_cancel(entry);
+        arp_timer_push(to, entry);
+    }
+}
+
+/**
+ * @brief Arm the state timer of an entry, replacing any armed one
+ *
+ * Called with the table lock held.
+ *
+ * @param table Pointer to ARP table structure
+ * @param entry Entry to arm
+ * @param deadline When the timer fires (s)
+ */
+static void arp_timer_arm(arp_table_t *table, arp_entry_t *entry, uint32_t deadline) {
+    uint32_t when = deadline;
+
+    arp_timer_cancel(entry);
+    entry->timer_deadline = deadline;
+
+    if ((int32_t)(when - table->wheel_time) <= 0) {
+        when = table->wheel_time + 1;
+    }
+
+    if (when - table->wheel_time < ARP_WHEEL_L0_SLOTS) {
+        arp_timer_push(&table->wheel_l0[when & (ARP_WHEEL_L0_SLOTS - 1)], entry);
+        return;
+    }
+
+    /* Deadlines beyond the wheel wait in its last turn and are re-armed from there */
+    uint32_t turns = (when >> ARP_WHEEL_L0_BITS) - (table->wheel_time >> ARP_WHEEL_L0_BITS);
+    if (turns >= ARP_WHEEL_L1_SLOTS) {
+        when = table->wheel_time + ((ARP_WHEEL_L1_SLOTS - 1) << ARP_WHEEL_L0_BITS);
+    }
+    arp_timer_push(&table->wheel_l1[(when >> ARP_WHEEL_L0_BITS) & (ARP_WHEEL_L1_SLOTS - 1)], entry);
+}
+
+/**
+ * @brief Disarm the state timer of an entry
+ *
+ * @param entry Entry to disarm
+ */
+static void arp_timer_cancel(arp_entry_t *entry) {
+    if (!entry->timer_pprev) {
+        return;
+    }
+
+    *entry->timer_pprev = entry->timer_next;
+    if (entry->timer_next) {
+        entry->timer_next->timer_pprev = entry->timer_pprev;
+    }
+    entry->timer_next = NULL;
+    entry->timer_pprev = NULL;
+}
+
+/**
+ * @brief Current monotonic time in nanoseconds, from the simulator clock
+ */
+static uint64_t arp_now_ns(void) {
+    return sim_clock_now_us() * 1000;
+}
+
+/**
+ * @brief Get current time in seconds
  *
  * @return uint32_t Current time in seconds
  */
 static uint32_t get_current_time(void) {
-    /* This should use a system-specific function to get the current time */
-    /* For now, returning a simple counter that increments with each call */
-    static uint32_t time_counter = 0;
-    return time_counter++;
+    /* Seconds of the monotonic clock, so that timers survive wall-clock changes */
+    return (uint32_t)(arp_now_ns() / ARP_NS_PER_SEC);
 }
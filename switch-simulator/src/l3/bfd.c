@@ -0,0 +1,1272 @@
+/**
+ * @file bfd.c
+ * @brief Implementation of the BFD engine
+ *
+ * Sessions live in one preallocated array; the local discriminator of a
+ * session is its slot plus a generation in the upper half, so a packet
+ * finds its session without a search and a stale discriminator never
+ * matches a reused slot. Packets that do not know our discriminator yet
+ * are matched on the neighbor address and port through a keyed hash.
+ *
+ * Timers never send by themselves. An expiring transmit timer puts its
+ * session on the list of its port and arms the flush timer for the next
+ * tick; the flush patches the flags byte of every queued template, sends
+ * each port's packets in bursts of BFD_TX_BURST and then runs the state
+ * callbacks, outside the engine lock.
+ *
+ * The detection timer is not restarted by every packet. A packet only
+ * moves the deadline; the timer, when it fires early, re-arms itself for
+ * what is left. One lock serializes the punt thread, the event loop and
+ * the configuration calls.
+ */
+
+#include "l3/bfd.h"
+#include "l3/arp.h"
+#include "l3/ip.h"
+#include "l3/ip_processing.h"
+#include "l3/punt.h"
+#include "l3/routing_table.h"
+#include "common/config.h"
+#include "common/logging.h"
+#include "common/error_codes.h"
+#include "common/event_loop.h"
+#include "common/keyed_hash.h"
+#include "common/rcu.h"
+#include "hal/packet.h"
+#include "hal/port.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+/* Defines */
+#define BFD_PEER_HASH_SIZE 4096         /* Buckets of the neighbor hash, a power of two */
+#define BFD_TX_BURST 64                 /* Packets handed to a port at once */
+#define BFD_NOTIFY_BATCH 64             /* State changes delivered per lock release */
+#define BFD_UDP_HEADER_LEN 8
+#define BFD_TTL 255                     /* Sent and required on receipt (RFC 5881 5) */
+#define BFD_TOS 0xC0                    /* Internetwork control */
+#define BFD_SRC_PORT_COUNT 16384        /* Source ports 49152..65535 (RFC 5881 4) */
+#define BFD_FRAME_MAX (ARP_REWRITE_MAX_LEN + IPV4_HEADER_MIN_LEN + BFD_UDP_HEADER_LEN + BFD_CONTROL_LEN)
+
+/* Flags of the second byte, below the state */
+#define BFD_FLAG_POLL 0x20
+#define BFD_FLAG_FINAL 0x10
+#define BFD_FLAG_AUTH 0x04
+#define BFD_FLAG_MULTIPOINT 0x01
+
+/* Private data types */
+
+/* Control packet without authentication (RFC 5880 4.1) */
+typedef struct __attribute__((packed)) {
+    uint8_t version_diag;           /* Version in the top 3 bits, diagnostic below */
+    uint8_t state_flags;            /* State in the top 2 bits, flags below */
+    uint8_t detect_mult;
+    uint8_t length;
+    uint32_t my_discr;              /* Network order, as are the fields below */
+    uint32_t your_discr;
+    uint32_t desired_min_tx;
+    uint32_t required_min_rx;
+    uint32_t required_min_echo_rx;
+} bfd_control_t;
+
+/* One session */
+typedef struct {
+    bool in_use;
+    uint16_t generation;            /* Upper half of the discriminator, bumped on every add */
+    bfd_session_config_t config;    /* Defaults filled in */
+
+    bfd_state_t state;
+    bfd_diag_t diag;
+    bfd_state_t remote_state;
+    uint32_t local_discr;
+    uint32_t remote_discr;
+    uint32_t remote_min_rx;         /* 1 until the neighbor is heard, 0 asks us not to send */
+    uint32_t remote_desired_tx;
+    uint8_t remote_detect_mult;     /* 0 until the neighbor is heard */
+
+    uint32_t adv_tx;                /* Intervals we advertise */
+    uint32_t adv_rx;
+    uint32_t active_tx;             /* Intervals in use, behind the advertised ones during a poll */
+    uint32_t active_rx;
+    bool poll;                      /* Poll sequence running */
+    bool final_due;                 /* Next packet answers a poll */
+    bool nexthop_down;              /* We marked the neighbor's next hop down */
+
+    event_timer_t tx_timer;
+    event_timer_t detect_timer;
+    uint64_t detect_deadline;       /* Absolute, 0 if not running */
+    uint64_t detect_armed;          /* Expiry the detection timer was last started for */
+
+    uint32_t peer_next;             /* Neighbor hash chain, slot + 1, 0 ends it */
+    bool tx_queued;                 /* On the transmit list of its port */
+    uint32_t tx_next;
+    bool notify_queued;             /* On the notification list */
+    uint32_t notify_next;
+    bfd_state_t reported_state;     /* Last state given to subscribers */
+
+    bool frame_stale;               /* Ethernet, IP or UDP header must be rebuilt */
+    bool control_stale;             /* Control fields other than the flags changed */
+    uint32_t arp_generation;        /* Neighbor generation of the Ethernet header */
+    uint16_t control_offset;        /* Offset of the control packet in frame */
+    packet_buffer_t packet;         /* Template handed to the port, data is frame */
+    uint8_t frame[BFD_FRAME_MAX];
+
+    uint64_t tx_packets;
+    uint64_t rx_packets;
+    uint64_t up_transitions;
+    uint64_t down_transitions;
+} bfd_session_t;
+
+/* State change subscriber */
+typedef struct {
+    bfd_state_cb_t cb;
+    void *arg;
+} bfd_subscriber_t;
+
+/* State change being delivered */
+typedef struct {
+    uint32_t session_id;
+    bfd_state_t state;
+    bfd_diag_t diag;
+} bfd_notice_t;
+
+/* Engine state */
+typedef struct {
+    bool initialized;
+    pthread_mutex_t lock;
+    bfd_session_t *sessions;        /* CONFIG_BFD_MAX_SESSIONS */
+    uint32_t *peer_hash;            /* BFD_PEER_HASH_SIZE chain heads, slot + 1 */
+    uint32_t next_free;             /* Where the search for a free slot starts */
+    uint32_t jitter_state;          /* xorshift32 */
+
+    event_timer_t flush_timer;
+    bool flush_armed;
+    uint32_t tx_head[CONFIG_MAX_PORTS];     /* Transmit list of each port, slot + 1 */
+    uint32_t tx_tail[CONFIG_MAX_PORTS];
+    uint16_t tx_ports[CONFIG_MAX_PORTS];    /* Ports with a non-empty list */
+    uint32_t tx_port_count;
+    uint32_t notify_head;
+    uint32_t notify_tail;
+
+    bfd_subscriber_t subscribers[BFD_MAX_SUBSCRIBERS];
+    uint32_t subscriber_count;
+    bfd_stats_t stats;
+} bfd_engine_t;
+
+/* Global variables */
+static bfd_engine_t g_bfd = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* Forward declarations of private functions */
+static bfd_session_t *bfd_lookup(uint32_t session_id);
+static uint32_t bfd_peer_bucket(ipv4_addr_t peer, port_id_t port);
+static bfd_session_t *bfd_peer_find(ipv4_addr_t peer, port_id_t port);
+static void bfd_peer_unlink(bfd_session_t *s);
+static uint32_t bfd_jitter(uint32_t interval, uint8_t detect_mult);
+static void bfd_update_intervals(bfd_session_t *s);
+static void bfd_schedule_tx(bfd_session_t *s);
+static void bfd_arm_detect(bfd_session_t *s);
+static void bfd_queue_tx(bfd_session_t *s);
+static void bfd_queue_notify(bfd_session_t *s);
+static void bfd_hold_nexthop(bfd_session_t *s, bool down);
+static void bfd_set_state(bfd_session_t *s, bfd_state_t state, bfd_diag_t diag, bool hold_nexthop);
+static bool bfd_prepare(bfd_session_t *s);
+static void bfd_receive(packet_buffer_t *packet);
+static void bfd_tx_timer_cb(event_timer_t *timer, void *arg);
+static void bfd_detect_timer_cb(event_timer_t *timer, void *arg);
+static void bfd_flush_cb(event_timer_t *timer, void *arg);
+static uint32_t bfd_sum(uint32_t sum, const uint8_t *data, size_t len);
+static uint16_t bfd_fold(uint32_t sum);
+
+/**
+ * @brief Allocate the sessions and register for punted BFD packets
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t bfd_init(void) {
+    status_t err;
+
+    pthread_mutex_lock(&g_bfd.lock);
+    if (g_bfd.initialized) {
+        pthread_mutex_unlock(&g_bfd.lock);
+        return STATUS_SUCCESS;
+    }
+
+    keyed_hash_init();
+    g_bfd.sessions = calloc(CONFIG_BFD_MAX_SESSIONS, sizeof(bfd_session_t));
+    g_bfd.peer_hash = calloc(BFD_PEER_HASH_SIZE, sizeof(uint32_t));
+    if (!g_bfd.sessions || !g_bfd.peer_hash) {
+        free(g_bfd.sessions);
+        free(g_bfd.peer_hash);
+        g_bfd.sessions = NULL;
+        g_bfd.peer_hash = NULL;
+        pthread_mutex_unlock(&g_bfd.lock);
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to allocate %u BFD sessions", CONFIG_BFD_MAX_SESSIONS);
+        return STATUS_NO_MEMORY;
+    }
+
+    for (uint32_t i = 0; i < CONFIG_BFD_MAX_SESSIONS; i++) {
+        bfd_session_t *s = &g_bfd.sessions[i];
+        event_timer_init(&s->tx_timer, bfd_tx_timer_cb, s);
+        event_timer_init(&s->detect_timer, bfd_detect_timer_cb, s);
+        s->packet.data = s->frame;
+        s->packet.capacity = sizeof(s->frame);
+    }
+    event_timer_init(&g_bfd.flush_timer, bfd_flush_cb, NULL);
+
+    g_bfd.next_free = 0;
+    g_bfd.jitter_state = (uint32_t)event_loop_now_us() | 1;
+    g_bfd.flush_armed = false;
+    g_bfd.tx_port_count = 0;
+    g_bfd.notify_head = 0;
+    g_bfd.notify_tail = 0;
+    memset(g_bfd.tx_head, 0, sizeof(g_bfd.tx_head));
+    memset(&g_bfd.stats, 0, sizeof(g_bfd.stats));
+    g_bfd.initialized = true;
+    pthread_mutex_unlock(&g_bfd.lock);
+
+    // Without the punt path sessions still send, but never come up
+    err = punt_set_handler(PUNT_CLASS_BFD, bfd_receive_burst, NULL);
+    if (err != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_L3, "BFD: no punt path, control packets will not be received (%d)", err);
+    }
+
+    LOG_INFO(LOG_CATEGORY_L3, "BFD engine initialized with %u sessions", CONFIG_BFD_MAX_SESSIONS);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Stop every session and release the engine
+ *
+ * @return STATUS_SUCCESS on success, STATUS_NOT_INITIALIZED if not initialized
+ */
+status_t bfd_shutdown(void) {
+    bfd_session_t *sessions;
+    uint32_t *peer_hash;
+
+    pthread_mutex_lock(&g_bfd.lock);
+    if (!g_bfd.initialized) {
+        pthread_mutex_unlock(&g_bfd.lock);
+        return STATUS_NOT_INITIALIZED;
+    }
+    (void)punt_set_handler(PUNT_CLASS_BFD, NULL, NULL);
+
+    for (uint32_t i = 0; i < CONFIG_BFD_MAX_SESSIONS; i++) {
+        bfd_session_t *s = &g_bfd.sessions[i];
+        if (s->in_use) {
+            bfd_hold_nexthop(s, false);
+        }
+        event_timer_stop(&s->tx_timer);
+        event_timer_stop(&s->detect_timer);
+    }
+    event_timer_stop(&g_bfd.flush_timer);
+
+    // Callbacks already past the wheel find the engine gone and return
+    g_bfd.initialized = false;
+    sessions = g_bfd.sessions;
+    peer_hash = g_bfd.peer_hash;
+    g_bfd.sessions = NULL;
+    g_bfd.peer_hash = NULL;
+    g_bfd.subscriber_count = 0;
+    pthread_mutex_unlock(&g_bfd.lock);
+
+    free(sessions);
+    free(peer_hash);
+    LOG_INFO(LOG_CATEGORY_L3, "BFD engine shut down");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Start a session to a neighbor
+ *
+ * @param config Parameters
+ * @param session_id Where to store the session, also its local discriminator
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t bfd_session_add(const bfd_session_config_t *config, uint32_t *session_id) {
+    bfd_session_config_t cfg;
+    bfd_session_t *s = NULL;
+    uint32_t index = 0;
+
+    if (!config || !session_id || config->peer == 0 || config->port >= CONFIG_MAX_PORTS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    cfg = *config;
+    if (cfg.desired_min_tx_us == 0) {
+        cfg.desired_min_tx_us = BFD_DEFAULT_TX_US;
+    }
+    if (cfg.required_min_rx_us == 0) {
+        cfg.required_min_rx_us = BFD_DEFAULT_RX_US;
+    }
+    if (cfg.detect_mult == 0) {
+        cfg.detect_mult = BFD_DEFAULT_DETECT_MULT;
+    }
+    if (cfg.desired_min_tx_us < BFD_MIN_INTERVAL_US || cfg.required_min_rx_us < BFD_MIN_INTERVAL_US) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_bfd.lock);
+    if (!g_bfd.initialized) {
+        pthread_mutex_unlock(&g_bfd.lock);
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (bfd_peer_find(cfg.peer, cfg.port)) {
+        pthread_mutex_unlock(&g_bfd.lock);
+        return STATUS_ALREADY_EXISTS;
+    }
+
+    // A slot still on a list waits for the flush to take it off
+    for (uint32_t n = 0; n < CONFIG_BFD_MAX_SESSIONS; n++) {
+        uint32_t i = (g_bfd.next_free + n) % CONFIG_BFD_MAX_SESSIONS;
+        bfd_session_t *candidate = &g_bfd.sessions[i];
+        if (!candidate->in_use && !candidate->tx_queued && !candidate->notify_queued) {
+            s = candidate;
+            index = i;
+            break;
+        }
+    }
+    if (!s) {
+        pthread_mutex_unlock(&g_bfd.lock);
+        LOG_WARNING(LOG_CATEGORY_L3, "BFD: all %u sessions in use", CONFIG_BFD_MAX_SESSIONS);
+        return STATUS_RESOURCE_EXHAUSTED;
+    }
+    g_bfd.next_free = (index + 1) % CONFIG_BFD_MAX_SESSIONS;
+
+    s->generation++;
+    if (s->generation == 0) {
+        s->generation = 1;
+    }
+    s->in_use = true;
+    s->config = cfg;
+    s->state = BFD_STATE_DOWN;
+    s->diag = BFD_DIAG_NONE;
+    s->remote_state = BFD_STATE_DOWN;
+    s->local_discr = ((uint32_t)s->generation << 16) | (index + 1);
+    s->remote_discr = 0;
+    s->remote_min_rx = 1;
+    s->remote_desired_tx = 0;
+    s->remote_detect_mult = 0;
+    s->adv_tx = 0;
+    s->adv_rx = 0;
+    s->poll = false;
+    s->final_due = false;
+    s->nexthop_down = false;
+    s->detect_deadline = 0;
+    s->detect_armed = 0;
+    s->reported_state = BFD_STATE_DOWN;
+    s->frame_stale = true;
+    s->control_stale = true;
+    s->tx_packets = 0;
+    s->rx_packets = 0;
+    s->up_transitions = 0;
+    s->down_transitions = 0;
+    bfd_update_intervals(s);
+
+    uint32_t bucket = bfd_peer_bucket(cfg.peer, cfg.port);
+    s->peer_next = g_bfd.peer_hash[bucket];
+    g_bfd.peer_hash[bucket] = index + 1;
+    g_bfd.stats.sessions++;
+
+    bfd_queue_tx(s);
+    bfd_schedule_tx(s);
+    *session_id = s->local_discr;
+    pthread_mutex_unlock(&g_bfd.lock);
+
+    LOG_DEBUG(LOG_CATEGORY_L3, "BFD session %08x to %08x on port %u, tx %u us, rx %u us, mult %u",
+              *session_id, ntohl(cfg.peer), cfg.port, cfg.desired_min_tx_us, cfg.required_min_rx_us,
+              cfg.detect_mult);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Stop and remove a session
+ *
+ * @param session_id Session
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t bfd_session_remove(uint32_t session_id) {
+    bfd_session_t *s;
+
+    pthread_mutex_lock(&g_bfd.lock);
+    s = bfd_lookup(session_id);
+    if (!s) {
+        pthread_mutex_unlock(&g_bfd.lock);
+        return STATUS_NOT_FOUND;
+    }
+
+    bfd_hold_nexthop(s, false);
+    event_timer_stop(&s->tx_timer);
+    event_timer_stop(&s->detect_timer);
+    bfd_peer_unlink(s);
+    if (s->state == BFD_STATE_UP) {
+        g_bfd.stats.sessions_up--;
+    }
+    s->in_use = false;
+    g_bfd.stats.sessions--;
+    pthread_mutex_unlock(&g_bfd.lock);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Change the intervals of a session
+ *
+ * @param session_id Session
+ * @param desired_min_tx_us Desired minimum transmit interval
+ * @param required_min_rx_us Required minimum receive interval
+ * @param detect_mult Detection multiplier
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t bfd_session_set_intervals(uint32_t session_id, uint32_t desired_min_tx_us,
+                                   uint32_t required_min_rx_us, uint8_t detect_mult) {
+    bfd_session_t *s;
+
+    if (desired_min_tx_us < BFD_MIN_INTERVAL_US || required_min_rx_us < BFD_MIN_INTERVAL_US ||
+        detect_mult == 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_bfd.lock);
+    s = bfd_lookup(session_id);
+    if (!s) {
+        pthread_mutex_unlock(&g_bfd.lock);
+        return STATUS_NOT_FOUND;
+    }
+
+    s->config.desired_min_tx_us = desired_min_tx_us;
+    s->config.required_min_rx_us = required_min_rx_us;
+    if (s->config.detect_mult != detect_mult) {
+        s->config.detect_mult = detect_mult;
+        s->control_stale = true;
+    }
+    bfd_update_intervals(s);
+    if (s->poll) {
+        bfd_queue_tx(s);
+    }
+    bfd_schedule_tx(s);
+    bfd_arm_detect(s);
+    pthread_mutex_unlock(&g_bfd.lock);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Take a session administratively down, or bring it back
+ *
+ * @param session_id Session
+ * @param admin_down true to take it down
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t bfd_session_set_admin(uint32_t session_id, bool admin_down) {
+    bfd_session_t *s;
+
+    pthread_mutex_lock(&g_bfd.lock);
+    s = bfd_lookup(session_id);
+    if (!s) {
+        pthread_mutex_unlock(&g_bfd.lock);
+        return STATUS_NOT_FOUND;
+    }
+
+    if (admin_down && s->state != BFD_STATE_ADMIN_DOWN) {
+        bfd_set_state(s, BFD_STATE_ADMIN_DOWN, BFD_DIAG_ADMIN_DOWN, false);
+        bfd_hold_nexthop(s, false);
+        s->detect_deadline = 0;
+    } else if (!admin_down && s->state == BFD_STATE_ADMIN_DOWN) {
+        bfd_set_state(s, BFD_STATE_DOWN, BFD_DIAG_NONE, false);
+    }
+    pthread_mutex_unlock(&g_bfd.lock);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the state of a session
+ *
+ * @param session_id Session
+ * @param info Where to store the state
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t bfd_session_get_info(uint32_t session_id, bfd_session_info_t *info) {
+    bfd_session_t *s;
+
+    if (!info) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_bfd.lock);
+    s = bfd_lookup(session_id);
+    if (!s) {
+        pthread_mutex_unlock(&g_bfd.lock);
+        return STATUS_NOT_FOUND;
+    }
+
+    info->state = s->state;
+    info->diag = s->diag;
+    info->remote_state = s->remote_state;
+    info->local_discr = s->local_discr;
+    info->remote_discr = s->remote_discr;
+    info->tx_interval_us = s->remote_min_rx == 0 ? 0 :
+                           (s->active_tx > s->remote_min_rx ? s->active_tx : s->remote_min_rx);
+    info->detect_time_us = s->remote_detect_mult == 0 ? 0 :
+                           s->remote_detect_mult * (s->active_rx > s->remote_desired_tx ?
+                                                    s->active_rx : s->remote_desired_tx);
+    info->tx_packets = s->tx_packets;
+    info->rx_packets = s->rx_packets;
+    info->up_transitions = s->up_transitions;
+    info->down_transitions = s->down_transitions;
+    pthread_mutex_unlock(&g_bfd.lock);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Handle received control packets
+ *
+ * @param packets Packets, lent by the punt path
+ * @param count Number of packets
+ * @param ctx Unused
+ */
+void bfd_receive_burst(packet_buffer_t **packets, uint32_t count, void *ctx) {
+    (void)ctx;
+
+    if (!packets) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_bfd.lock);
+    if (g_bfd.initialized) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (packets[i]) {
+                bfd_receive(packets[i]);
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_bfd.lock);
+}
+
+/**
+ * @brief Be told of session state changes
+ *
+ * @param cb Callback
+ * @param arg Passed to cb
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t bfd_subscribe(bfd_state_cb_t cb, void *arg) {
+    if (!cb) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_bfd.lock);
+    if (g_bfd.subscriber_count >= BFD_MAX_SUBSCRIBERS) {
+        pthread_mutex_unlock(&g_bfd.lock);
+        return STATUS_RESOURCE_EXHAUSTED;
+    }
+    g_bfd.subscribers[g_bfd.subscriber_count].cb = cb;
+    g_bfd.subscribers[g_bfd.subscriber_count].arg = arg;
+    g_bfd.subscriber_count++;
+    pthread_mutex_unlock(&g_bfd.lock);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Stop being told of session state changes
+ *
+ * @param cb Callback given to bfd_subscribe()
+ * @param arg Argument given to bfd_subscribe()
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t bfd_unsubscribe(bfd_state_cb_t cb, void *arg) {
+    pthread_mutex_lock(&g_bfd.lock);
+    for (uint32_t i = 0; i < g_bfd.subscriber_count; i++) {
+        if (g_bfd.subscribers[i].cb == cb && g_bfd.subscribers[i].arg == arg) {
+            memmove(&g_bfd.subscribers[i], &g_bfd.subscribers[i + 1],
+                    (g_bfd.subscriber_count - i - 1) * sizeof(bfd_subscriber_t));
+            g_bfd.subscriber_count--;
+            pthread_mutex_unlock(&g_bfd.lock);
+            return STATUS_SUCCESS;
+        }
+    }
+    pthread_mutex_unlock(&g_bfd.lock);
+
+    return STATUS_NOT_FOUND;
+}
+
+/**
+ * @brief Get engine counters
+ *
+ * @param stats Where to store the counters
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t bfd_get_stats(bfd_stats_t *stats) {
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_bfd.lock);
+    if (!g_bfd.initialized) {
+        pthread_mutex_unlock(&g_bfd.lock);
+        return STATUS_NOT_INITIALIZED;
+    }
+    *stats = g_bfd.stats;
+    pthread_mutex_unlock(&g_bfd.lock);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Find a session by its discriminator
+ *
+ * @param session_id Session, the local discriminator
+ * @return Session, NULL if there is none or the engine is down
+ */
+static bfd_session_t *bfd_lookup(uint32_t session_id) {
+    uint32_t slot = session_id & 0xFFFF;
+    bfd_session_t *s;
+
+    if (!g_bfd.initialized || slot == 0 || slot > CONFIG_BFD_MAX_SESSIONS) {
+        return NULL;
+    }
+    s = &g_bfd.sessions[slot - 1];
+    return s->in_use && s->local_discr == session_id ? s : NULL;
+}
+
+/**
+ * @brief Bucket of a neighbor in the neighbor hash
+ */
+static uint32_t bfd_peer_bucket(ipv4_addr_t peer, port_id_t port) {
+    return (uint32_t)keyed_hash_u64(((uint64_t)peer << 16) | port) & (BFD_PEER_HASH_SIZE - 1);
+}
+
+/**
+ * @brief Find the session to a neighbor on a port
+ */
+static bfd_session_t *bfd_peer_find(ipv4_addr_t peer, port_id_t port) {
+    uint32_t index = g_bfd.peer_hash[bfd_peer_bucket(peer, port)];
+
+    while (index) {
+        bfd_session_t *s = &g_bfd.sessions[index - 1];
+        if (s->config.peer == peer && s->config.port == port) {
+            return s;
+        }
+        index = s->peer_next;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Take a session out of the neighbor hash
+ */
+static void bfd_peer_unlink(bfd_session_t *s) {
+    uint32_t *link = &g_bfd.peer_hash[bfd_peer_bucket(s->config.peer, s->config.port)];
+    uint32_t self = (uint32_t)(s - g_bfd.sessions) + 1;
+
+    while (*link) {
+        if (*link == self) {
+            *link = s->peer_next;
+            s->peer_next = 0;
+            return;
+        }
+        link = &g_bfd.sessions[*link - 1].peer_next;
+    }
+}
+
+/**
+ * @brief Interval with jitter applied (RFC 5880 6.8.7)
+ *
+ * 75 to 100 percent of the interval, and at most 90 percent with a
+ * detection multiplier of 1.
+ */
+static uint32_t bfd_jitter(uint32_t interval, uint8_t detect_mult) {
+    uint32_t x = g_bfd.jitter_state;
+    uint32_t span = detect_mult == 1 ? 15 : 25;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    g_bfd.jitter_state = x;
+
+    return (uint32_t)((uint64_t)interval * (75 + x % (span + 1)) / 100);
+}
+
+/**
+ * @brief Recompute the advertised intervals and apply what may be applied
+ *
+ * While Up, a change starts a poll sequence. A shorter transmit interval
+ * and a longer receive interval are safe at once; the others wait for the
+ * Final (RFC 5880 6.8.3). While not Up we send no faster than once a
+ * second.
+ */
+static void bfd_update_intervals(bfd_session_t *s) {
+    uint32_t tx = s->config.desired_min_tx_us;
+    uint32_t rx = s->config.required_min_rx_us;
+
+    if (s->state != BFD_STATE_UP && tx < BFD_SLOW_TX_US) {
+        tx = BFD_SLOW_TX_US;
+    }
+    if (tx == s->adv_tx && rx == s->adv_rx) {
+        return;
+    }
+
+    s->adv_tx = tx;
+    s->adv_rx = rx;
+    s->control_stale = true;
+
+    if (s->state != BFD_STATE_UP) {
+        s->active_tx = tx;
+        s->active_rx = rx;
+        return;
+    }
+
+    s->poll = true;
+    if (tx < s->active_tx) {
+        s->active_tx = tx;
+    }
+    if (rx > s->active_rx) {
+        s->active_rx = rx;
+    }
+}
+
+/**
+ * @brief Re-arm the transmit timer for the interval now in use
+ *
+ * The neighbor asking for a receive interval of zero stops us.
+ */
+static void bfd_schedule_tx(bfd_session_t *s) {
+    uint32_t interval;
+
+    if (s->remote_min_rx == 0) {
+        event_timer_stop(&s->tx_timer);
+        return;
+    }
+    interval = s->active_tx > s->remote_min_rx ? s->active_tx : s->remote_min_rx;
+    event_timer_start(&s->tx_timer, bfd_jitter(interval, s->config.detect_mult), 0);
+}
+
+/**
+ * @brief Push the detection deadline back by one detection time
+ *
+ * The timer is only restarted when the deadline moves earlier than where
+ * it already fires; otherwise it re-arms itself when it gets there.
+ */
+static void bfd_arm_detect(bfd_session_t *s) {
+    uint32_t detect;
+    uint64_t now;
+
+    if (s->remote_detect_mult == 0 || s->state == BFD_STATE_ADMIN_DOWN) {
+        return;
+    }
+
+    detect = s->remote_detect_mult * (s->active_rx > s->remote_desired_tx ? s->active_rx : s->remote_desired_tx);
+    now = event_loop_now_us();
+    s->detect_deadline = now + detect;
+
+    if (!event_timer_pending(&s->detect_timer) || s->detect_deadline < s->detect_armed) {
+        s->detect_armed = s->detect_deadline;
+        event_timer_start(&s->detect_timer, detect, 0);
+    }
+}
+
+/**
+ * @brief Put a session on the transmit list of its port
+ */
+static void bfd_queue_tx(bfd_session_t *s) {
+    uint32_t self = (uint32_t)(s - g_bfd.sessions) + 1;
+    port_id_t port = s->config.port;
+
+    if (s->tx_queued) {
+        return;
+    }
+    s->tx_queued = true;
+    s->tx_next = 0;
+    if (g_bfd.tx_head[port] == 0) {
+        g_bfd.tx_head[port] = self;
+        g_bfd.tx_ports[g_bfd.tx_port_count++] = port;
+    } else {
+        g_bfd.sessions[g_bfd.tx_tail[port] - 1].tx_next = self;
+    }
+    g_bfd.tx_tail[port] = self;
+
+    if (!g_bfd.flush_armed && event_timer_start(&g_bfd.flush_timer, 0, 0) == STATUS_SUCCESS) {
+        g_bfd.flush_armed = true;
+    }
+}
+
+/**
+ * @brief Put a session on the notification list
+ *
+ * A session is queued once; the flush reports whatever state it is in by
+ * then.
+ */
+static void bfd_queue_notify(bfd_session_t *s) {
+    uint32_t self = (uint32_t)(s - g_bfd.sessions) + 1;
+
+    if (s->notify_queued) {
+        return;
+    }
+    s->notify_queued = true;
+    s->notify_next = 0;
+    if (g_bfd.notify_head == 0) {
+        g_bfd.notify_head = self;
+    } else {
+        g_bfd.sessions[g_bfd.notify_tail - 1].notify_next = self;
+    }
+    g_bfd.notify_tail = self;
+
+    if (!g_bfd.flush_armed && event_timer_start(&g_bfd.flush_timer, 0, 0) == STATUS_SUCCESS) {
+        g_bfd.flush_armed = true;
+    }
+}
+
+/**
+ * @brief Mark the neighbor's next hop down, or release it
+ *
+ * Every route through the next hop follows at once; a neighbor no route
+ * uses yet is not an error.
+ */
+static void bfd_hold_nexthop(bfd_session_t *s, bool down) {
+    ip_addr_t next_hop;
+
+    if (s->nexthop_down == down) {
+        return;
+    }
+
+    memset(&next_hop, 0, sizeof(next_hop));
+    next_hop.type = IP_TYPE_V4;
+    next_hop.addr.v4 = s->config.peer;
+    (void)routing_set_nexthop_state(&next_hop, IP_TYPE_V4, s->config.port, !down);
+    s->nexthop_down = down;
+}
+
+/**
+ * @brief Change the state of a session
+ *
+ * The new state goes out at once, and the intervals follow it.
+ *
+ * @param s Session
+ * @param state New state
+ * @param diag Diagnostic
+ * @param hold_nexthop Leaving Up is a failure: mark the next hop down
+ */
+static void bfd_set_state(bfd_session_t *s, bfd_state_t state, bfd_diag_t diag, bool hold_nexthop) {
+    bfd_state_t old = s->state;
+
+    if (old == state) {
+        return;
+    }
+
+    s->state = state;
+    s->control_stale = true;
+    g_bfd.stats.state_changes++;
+
+    if (state == BFD_STATE_UP) {
+        s->diag = BFD_DIAG_NONE;
+        s->up_transitions++;
+        g_bfd.stats.sessions_up++;
+        bfd_hold_nexthop(s, false);
+    } else {
+        s->diag = diag;
+        if (old == BFD_STATE_UP) {
+            s->down_transitions++;
+            g_bfd.stats.sessions_up--;
+            if (hold_nexthop) {
+                bfd_hold_nexthop(s, true);
+            }
+        }
+        // A poll in flight is meaningless to a restarting neighbor
+        s->poll = false;
+        s->final_due = false;
+    }
+
+    LOG_DEBUG(LOG_CATEGORY_L3, "BFD session %08x: state %d -> %d, diag %d", s->local_discr, old, state, s->diag);
+
+    bfd_update_intervals(s);
+    bfd_queue_tx(s);
+    bfd_schedule_tx(s);
+    bfd_queue_notify(s);
+}
+
+/**
+ * @brief Bring a session's packet up to date before it is sent
+ *
+ * The Ethernet, IP and UDP headers are rebuilt when the neighbor's rewrite
+ * may have changed, the control fields when the session did, and the
+ * flags byte every time.
+ *
+ * @param s Session
+ * @return true if the packet may be sent, false if the neighbor is unresolved
+ */
+static bool bfd_prepare(bfd_session_t *s) {
+    uint32_t generation = arp_get_generation();
+    bfd_control_t *ctrl;
+
+    if (s->frame_stale || s->arp_generation != generation) {
+        const arp_rewrite_t *rewrite = NULL;
+        ipv4_header_t ip;
+        uint8_t *udp;
+        uint16_t src_port;
+        status_t err;
+
+        if (rcu_read_lock() != STATUS_SUCCESS) {
+            return false;
+        }
+        err = arp_get_rewrite(&s->config.peer, s->config.port, &rewrite);
+        if (err != STATUS_SUCCESS || !rewrite) {
+            rcu_read_unlock();
+            s->frame_stale = true;
+            return false;
+        }
+        memcpy(s->frame, rewrite->bytes, rewrite->len);
+        s->control_offset = rewrite->len + IPV4_HEADER_MIN_LEN + BFD_UDP_HEADER_LEN;
+        rcu_read_unlock();
+
+        // The header lands after the rewrite at no particular alignment, so it is built aside
+        memset(&ip, 0, sizeof(ip));
+        ip.version_ihl = (IP_VERSION_4 << 4) | (IPV4_HEADER_MIN_LEN / 4);
+        ip.tos = BFD_TOS;
+        ip.total_length = htons(IPV4_HEADER_MIN_LEN + BFD_UDP_HEADER_LEN + BFD_CONTROL_LEN);
+        ip.flags_fragment = htons(IP_FLAG_DF);
+        ip.ttl = BFD_TTL;
+        ip.protocol = IP_PROTO_UDP;
+        ip.src_addr = s->config.local;
+        ip.dst_addr = s->config.peer;
+        ip.header_checksum = bfd_fold(bfd_sum(0, (const uint8_t *)&ip, IPV4_HEADER_MIN_LEN));
+        udp = s->frame + s->control_offset - BFD_UDP_HEADER_LEN;
+        memcpy(udp - IPV4_HEADER_MIN_LEN, &ip, IPV4_HEADER_MIN_LEN);
+
+        // A zero UDP checksum lets the control fields change in place
+        src_port = htons(BFD_SRC_PORT_MIN + (uint16_t)((s - g_bfd.sessions) % BFD_SRC_PORT_COUNT));
+        memcpy(udp, &src_port, sizeof(src_port));
+        udp[2] = BFD_UDP_PORT >> 8;
+        udp[3] = BFD_UDP_PORT & 0xFF;
+        udp[4] = 0;
+        udp[5] = BFD_UDP_HEADER_LEN + BFD_CONTROL_LEN;
+        udp[6] = 0;
+        udp[7] = 0;
+
+        memset(&s->packet.metadata, 0, sizeof(s->packet.metadata));
+        s->packet.length = s->control_offset + BFD_CONTROL_LEN;
+        s->arp_generation = generation;
+        s->frame_stale = false;
+        s->control_stale = true;
+    }
+
+    ctrl = (bfd_control_t *)(s->frame + s->control_offset);
+    if (s->control_stale) {
+        ctrl->version_diag = (uint8_t)((BFD_VERSION << 5) | (s->diag & 0x1F));
+        ctrl->detect_mult = s->config.detect_mult;
+        ctrl->length = BFD_CONTROL_LEN;
+        ctrl->my_discr = htonl(s->local_discr);
+        ctrl->your_discr = htonl(s->remote_discr);
+        ctrl->desired_min_tx = htonl(s->adv_tx);
+        ctrl->required_min_rx = htonl(s->adv_rx);
+        ctrl->required_min_echo_rx = 0;
+        s->control_stale = false;
+    }
+
+    // Poll and Final never go out together (RFC 5880 6.8.7)
+    ctrl->state_flags = (uint8_t)(s->state << 6);
+    if (s->final_due) {
+        ctrl->state_flags |= BFD_FLAG_FINAL;
+        s->final_due = false;
+    } else if (s->poll) {
+        ctrl->state_flags |= BFD_FLAG_POLL;
+    }
+    return true;
+}
+
+/**
+ * @brief Receive one control packet (RFC 5880 6.8.6)
+ *
+ * Runs under the engine lock.
+ */
+static void bfd_receive(packet_buffer_t *packet) {
+    ipv4_header_t ip;
+    bfd_control_t ctrl;
+    uint16_t udp_len;
+    bfd_session_t *s;
+    bfd_state_t remote_state;
+    uint32_t your_discr;
+    uint32_t old_min_rx;
+    uint8_t flags;
+
+    if (packet_ensure_parsed(packet) != STATUS_SUCCESS ||
+        !packet_has_proto(packet, PACKET_PROTO_IPV4) || !packet_has_proto(packet, PACKET_PROTO_UDP) ||
+        packet_peek_data(packet, packet_l4_offset(packet) + 4, &udp_len, sizeof(udp_len)) != STATUS_SUCCESS ||
+        packet_peek_data(packet, packet_l4_offset(packet) + BFD_UDP_HEADER_LEN, &ctrl, sizeof(ctrl)) != STATUS_SUCCESS ||
+        packet_peek_data(packet, packet_l3_offset(packet), &ip, IPV4_HEADER_MIN_LEN) != STATUS_SUCCESS) {
+        g_bfd.stats.rx_invalid++;
+        return;
+    }
+
+    flags = ctrl.state_flags & 0x3F;
+    if ((ctrl.version_diag >> 5) != BFD_VERSION || ctrl.length < BFD_CONTROL_LEN ||
+        ntohs(udp_len) < BFD_UDP_HEADER_LEN + ctrl.length ||
+        ctrl.detect_mult == 0 || (flags & BFD_FLAG_MULTIPOINT) || ctrl.my_discr == 0 ||
+        (flags & BFD_FLAG_AUTH) || ip.ttl != BFD_TTL) {
+        g_bfd.stats.rx_invalid++;
+        return;
+    }
+
+    remote_state = (bfd_state_t)(ctrl.state_flags >> 6);
+    your_discr = ntohl(ctrl.your_discr);
+    if (your_discr != 0) {
+        s = bfd_lookup(your_discr);
+        if (s && (s->config.peer != ip.src_addr || s->config.port != packet->metadata.port)) {
+            s = NULL;
+        }
+    } else if (remote_state == BFD_STATE_DOWN || remote_state == BFD_STATE_ADMIN_DOWN) {
+        s = bfd_peer_find(ip.src_addr, packet->metadata.port);
+    } else {
+        g_bfd.stats.rx_invalid++;
+        return;
+    }
+    if (!s) {
+        g_bfd.stats.rx_no_session++;
+        return;
+    }
+
+    g_bfd.stats.rx_packets++;
+    s->rx_packets++;
+
+    if (s->remote_discr != ntohl(ctrl.my_discr)) {
+        s->remote_discr = ntohl(ctrl.my_discr);
+        s->control_stale = true;
+    }
+    s->remote_state = remote_state;
+    s->remote_desired_tx = ntohl(ctrl.desired_min_tx);
+    s->remote_detect_mult = ctrl.detect_mult;
+    old_min_rx = s->remote_min_rx;
+    s->remote_min_rx = ntohl(ctrl.required_min_rx);
+
+    if ((flags & BFD_FLAG_FINAL) && s->poll) {
+        s->poll = false;
+        s->active_tx = s->adv_tx;
+        s->active_rx = s->adv_rx;
+    }
+
+    if (s->state == BFD_STATE_ADMIN_DOWN) {
+        return;
+    }
+
+    if (remote_state == BFD_STATE_ADMIN_DOWN) {
+        // Taken down on purpose, not a failure of the path (RFC 5882 3.2)
+        if (s->state != BFD_STATE_DOWN) {
+            bfd_set_state(s, BFD_STATE_DOWN, BFD_DIAG_NEIGHBOR_DOWN, false);
+        }
+        bfd_hold_nexthop(s, false);
+    } else if (s->state == BFD_STATE_DOWN) {
+        if (remote_state == BFD_STATE_DOWN) {
+            bfd_set_state(s, BFD_STATE_INIT, BFD_DIAG_NONE, false);
+        } else if (remote_state == BFD_STATE_INIT) {
+            bfd_set_state(s, BFD_STATE_UP, BFD_DIAG_NONE, false);
+        }
+    } else if (s->state == BFD_STATE_INIT) {
+        if (remote_state == BFD_STATE_INIT || remote_state == BFD_STATE_UP) {
+            bfd_set_state(s, BFD_STATE_UP, BFD_DIAG_NONE, false);
+        }
+    } else if (remote_state == BFD_STATE_DOWN) {
+        bfd_set_state(s, BFD_STATE_DOWN, BFD_DIAG_NEIGHBOR_DOWN, true);
+    }
+
+    if (flags & BFD_FLAG_POLL) {
+        s->final_due = true;
+        bfd_queue_tx(s);
+    }
+    if (s->remote_min_rx != old_min_rx) {
+        bfd_schedule_tx(s);
+    }
+    bfd_arm_detect(s);
+}
+
+/**
+ * @brief Transmit timer: queue the next packet and re-arm
+ */
+static void bfd_tx_timer_cb(event_timer_t *timer, void *arg) {
+    bfd_session_t *s = (bfd_session_t *)arg;
+    (void)timer;
+
+    pthread_mutex_lock(&g_bfd.lock);
+    if (g_bfd.initialized && s->in_use) {
+        bfd_queue_tx(s);
+        bfd_schedule_tx(s);
+    }
+    pthread_mutex_unlock(&g_bfd.lock);
+}
+
+/**
+ * @brief Detection timer: declare the session down, or re-arm for the
+ * rest of a deadline packets have pushed back
+ */
+static void bfd_detect_timer_cb(event_timer_t *timer, void *arg) {
+    bfd_session_t *s = (bfd_session_t *)arg;
+    uint64_t now;
+    (void)timer;
+
+    pthread_mutex_lock(&g_bfd.lock);
+    if (!g_bfd.initialized || !s->in_use || s->detect_deadline == 0) {
+        pthread_mutex_unlock(&g_bfd.lock);
+        return;
+    }
+
+    now = event_loop_now_us();
+    if (now < s->detect_deadline) {
+        s->detect_armed = s->detect_deadline;
+        event_timer_start(&s->detect_timer, s->detect_deadline - now, 0);
+        pthread_mutex_unlock(&g_bfd.lock);
+        return;
+    }
+
+    s->detect_deadline = 0;
+    if (s->state == BFD_STATE_INIT || s->state == BFD_STATE_UP) {
+        g_bfd.stats.detect_expired++;
+        bfd_set_state(s, BFD_STATE_DOWN, BFD_DIAG_DETECT_EXPIRED, true);
+    }
+
+    // The neighbor is forgotten; we go back to sending at our own pace
+    s->remote_discr = 0;
+    s->remote_state = BFD_STATE_DOWN;
+    s->remote_min_rx = 1;
+    s->remote_detect_mult = 0;
+    s->control_stale = true;
+    bfd_schedule_tx(s);
+    pthread_mutex_unlock(&g_bfd.lock);
+}
+
+/**
+ * @brief Flush timer: send the queued packets per port, then report
+ * state changes to the subscribers
+ */
+static void bfd_flush_cb(event_timer_t *timer, void *arg) {
+    packet_t *burst[BFD_TX_BURST];
+    bfd_notice_t notices[BFD_NOTIFY_BATCH];
+    bfd_subscriber_t subscribers[BFD_MAX_SUBSCRIBERS];
+    uint32_t subscriber_count;
+    (void)timer;
+    (void)arg;
+
+    pthread_mutex_lock(&g_bfd.lock);
+    if (!g_bfd.initialized) {
+        pthread_mutex_unlock(&g_bfd.lock);
+        return;
+    }
+    g_bfd.flush_armed = false;
+
+    for (uint32_t p = 0; p < g_bfd.tx_port_count; p++) {
+        port_id_t port = g_bfd.tx_ports[p];
+        uint32_t index = g_bfd.tx_head[port];
+        uint16_t count = 0;
+
+        while (index) {
+            bfd_session_t *s = &g_bfd.sessions[index - 1];
+
+            index = s->tx_next;
+            s->tx_queued = false;
+            s->tx_next = 0;
+            if (!s->in_use) {
+                continue;
+            }
+            if (!bfd_prepare(s)) {
+                g_bfd.stats.tx_unresolved++;
+                continue;
+            }
+            burst[count++] = &s->packet;
+            s->tx_packets++;
+
+            if (count == BFD_TX_BURST) {
+                uint16_t sent = 0;
+
+                if (port_send_burst(port, burst, count, &sent) != STATUS_SUCCESS) {
+                    sent = 0;
+                }
+                g_bfd.stats.tx_packets += sent;
+                g_bfd.stats.tx_errors += count - sent;
+                g_bfd.stats.tx_bursts++;
+                count = 0;
+            }
+        }
+        if (count) {
+            uint16_t sent = 0;
+
+            if (port_send_burst(port, burst, count, &sent) != STATUS_SUCCESS) {
+                sent = 0;
+            }
+            g_bfd.stats.tx_packets += sent;
+            g_bfd.stats.tx_errors += count - sent;
+            g_bfd.stats.tx_bursts++;
+        }
+        g_bfd.tx_head[port] = 0;
+        g_bfd.tx_tail[port] = 0;
+    }
+    g_bfd.tx_port_count = 0;
+
+    // Callbacks may call back into the engine, so they run unlocked
+    while (g_bfd.initialized && g_bfd.notify_head) {
+        uint32_t n = 0;
+
+        while (g_bfd.notify_head && n < BFD_NOTIFY_BATCH) {
+            bfd_session_t *s = &g_bfd.sessions[g_bfd.notify_head - 1];
+
+            g_bfd.notify_head = s->notify_next;
+            s->notify_queued = false;
+            s->notify_next = 0;
+            if (!s->in_use || s->state == s->reported_state) {
+                continue;
+            }
+            s->reported_state = s->state;
+            notices[n].session_id = s->local_discr;
+            notices[n].state = s->state;
+            notices[n].diag = s->diag;
+            n++;
+        }
+        if (g_bfd.notify_head == 0) {
+            g_bfd.notify_tail = 0;
+        }
+
+        subscriber_count = g_bfd.subscriber_count;
+        memcpy(subscribers, g_bfd.subscribers, subscriber_count * sizeof(bfd_subscriber_t));
+        pthread_mutex_unlock(&g_bfd.lock);
+
+        for (uint32_t i = 0; i < n; i++) {
+            for (uint32_t j = 0; j < subscriber_count; j++) {
+                subscribers[j].cb(notices[i].session_id, notices[i].state, notices[i].diag, subscribers[j].arg);
+            }
+        }
+        pthread_mutex_lock(&g_bfd.lock);
+    }
+    pthread_mutex_unlock(&g_bfd.lock);
+}
+
+/**
+ * @brief Add bytes to a ones' complement sum
+ *
+ * @param sum Running sum
+ * @param data Bytes to add, read as big-endian 16-bit words
+ * @param len Number of bytes
+ * @return New running sum
+ */
+static uint32_t bfd_sum(uint32_t sum, const uint8_t *data, size_t len) {
+    while (len > 1) {
+        sum += ((uint32_t)data[0] << 8) | data[1];
+        data += 2;
+        len -= 2;
+    }
+    if (len) {
+        sum += (uint32_t)data[0] << 8;
+    }
+    return sum;
+}
+
+/**
+ * @brief Fold a ones' complement sum into a checksum field
+ *
+ * @param sum Running sum
+ * @return Checksum in network order
+ */
+static uint16_t bfd_fold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return htons((uint16_t)~sum);
+}
@@ -0,0 +1,1319 @@
+/**
+ * @file conntrack.c
+ * @brief Implementation of connection tracking and NAT
+ *
+ * A table is an array of connections handed out from a free stack, a
+ * chained hash over the keys of both directions and a timer wheel. Bucket
+ * heads and chain links are references, (index << 1 | direction) + 1, so
+ * one lookup finds a connection from either direction without a second
+ * entry. Only the owning worker touches a table, except for its reply
+ * copy queue: other workers take a free request from one ring and queue
+ * it on another, and the owner installs and recycles them on its next
+ * burst.
+ *
+ * NAT rules are an immutable array published through RCU; configuration
+ * is serialized by the module lock.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/config.h"
+#include "common/logging.h"
+#include "common/mem_account.h"
+#include "common/threading.h"
+#include "common/rcu.h"
+#include "common/ring.h"
+#include "common/keyed_hash.h"
+#include "common/sim_clock.h"
+#include "common/stats_shard.h"
+#include "hal/forwarding.h"
+#include "hal/packet_drop.h"
+#include "hal/port.h"
+#include "l3/ip.h"
+#include "l3/conntrack.h"
+
+#define CT_WHEEL_SLOTS          1024        /* One second each, a power of two */
+#define CT_SWEEP_BUDGET         64          /* Connections the wheel looks at per burst */
+#define CT_MIRROR_QUEUE         1024        /* Reply copy requests of one table, a power of two */
+#define CT_MIRROR_BURST         32
+#define CT_NAT_PORT_MIN         1024        /* Ports taken by rules that name none */
+#define CT_NAT_PORT_MAX         65535
+#define CT_NAT_ATTEMPTS         16          /* Candidate bindings per worker before giving up */
+#define CT_SHARED_TABLE         CONNTRACK_MAX_WORKERS
+
+#define CT_DIR_ORIG             0
+#define CT_DIR_REPLY            1
+
+#define CT_ETH_HLEN             14
+#define CT_TCP_HLEN             20
+#define CT_UDP_HLEN             8
+#define CT_ICMP_HLEN            8
+
+#define CT_TCP_FIN              0x01
+#define CT_TCP_SYN              0x02
+#define CT_TCP_RST              0x04
+#define CT_TCP_ACK              0x10
+
+#define CT_ICMP_ECHO_REPLY      0
+#define CT_ICMP_ECHO_REQUEST    8
+
+/* Connection flags */
+#define CT_F_SNAT               0x01
+#define CT_F_DNAT               0x02
+#define CT_F_REPLIED            0x04        /* A packet was seen in the reply direction */
+#define CT_F_FIN_ORIG           0x08
+#define CT_F_FIN_REPLY          0x10
+#define CT_F_MIRROR             0x20        /* Reply copy: only the reply key is hashed */
+#define CT_F_REMOTE             0x40        /* Replies go to another worker: only the original key is hashed */
+
+/* TCP states */
+enum {
+    CT_TCP_SYN_SENT = 0,
+    CT_TCP_ESTABLISHED,
+    CT_TCP_CLOSING,
+    CT_TCP_CLOSED
+};
+
+/**
+ * @brief Counters, by index in the stats_shard set
+ */
+enum {
+    CT_CTR_CREATED = 0,
+    CT_CTR_EXPIRED,
+    CT_CTR_TABLE_FULL,
+    CT_CTR_SNAT,
+    CT_CTR_DNAT,
+    CT_CTR_NAT_EXHAUSTED,
+    CT_CTR_TRANSLATED,
+    CT_CTR_UNTRACKED,
+    CT_CTR_MIRRORS_SENT,
+    CT_CTR_MIRROR_DROPS,
+    CT_CTR_COUNT
+};
+
+/**
+ * @brief Tuple of one direction, as in the headers
+ *
+ * For ICMP, src_port is the echo identifier and dst_port is 0, so that a
+ * request and its reply keep the identifier in the same place.
+ */
+typedef struct {
+    ipv4_addr_t src;
+    ipv4_addr_t dst;
+    uint16_t src_port;              /* Network order */
+    uint16_t dst_port;              /* Network order */
+    uint8_t protocol;
+    uint8_t pad[3];
+} ct_key_t;
+
+/**
+ * @brief Tracked connection
+ *
+ * A packet with key[d] is translated to the reverse of key[!d].
+ */
+typedef struct {
+    ct_key_t key[2];                /* By direction */
+    uint32_t hash[2];               /* Bucket hashes of the keys */
+    uint32_t chain[2];              /* Next reference in the bucket of each key */
+    uint32_t wheel_next;            /* Index + 1 of the next connection in the slot, 0 at the end */
+    uint32_t wheel_prev;
+    uint32_t slot_time;             /* Second of the wheel slot holding the connection */
+    uint32_t expires;               /* Second the connection expires */
+    uint32_t mirror_sent;           /* CT_F_REMOTE: second the reply copy was last sent */
+    uint16_t mirror_timeout;        /* CT_F_REMOTE: timeout it was sent with */
+    uint16_t ip_adjust[2];          /* Ones' complement sums added to the IP checksum, by direction */
+    uint16_t l4_adjust[2];          /* The same for the TCP, UDP or ICMP checksum */
+    uint8_t state;
+    uint8_t flags;
+    uint8_t mirror_worker;          /* CT_F_REMOTE: table holding the reply copy */
+} ct_flow_t;
+
+/**
+ * @brief Reply copy request, from the worker holding a connection to the
+ *        worker its replies hash to
+ */
+typedef struct {
+    uint32_t generation;            /* Flush generation of the sender */
+    uint32_t timeout;
+    uint8_t flags;                  /* CT_F_SNAT and CT_F_DNAT of the connection */
+    ct_key_t key[2];
+} ct_mirror_t;
+
+/**
+ * @brief Connections of one worker
+ */
+typedef struct {
+    uint32_t generation;            /* Flush generation the table was last emptied for */
+    uint32_t mask;                  /* Buckets - 1 */
+    uint32_t count;                 /* Connections, read by conntrack_get_stats() */
+    uint32_t used;                  /* Connections ever handed out */
+    uint32_t free_top;
+    uint32_t wheel_time;            /* Last second swept */
+    uint32_t *buckets;
+    uint32_t *free_stack;
+    ct_flow_t *flows;               /* CONFIG_CONNTRACK_FLOWS_PER_WORKER */
+    ct_mirror_t *mirrors;           /* CT_MIRROR_QUEUE requests */
+    ring_t *mirror_queue;           /* Requests from other workers, one consumer */
+    ring_t *mirror_free;            /* Requests free to take, one producer */
+    uint32_t wheel[CT_WHEEL_SLOTS]; /* Index + 1 of the first connection, 0 if empty */
+} ct_table_t;
+
+/**
+ * @brief Published NAT rules
+ */
+typedef struct {
+    rcu_head_t rcu;
+    uint32_t count;
+    conntrack_nat_rule_t rule[];
+} ct_rules_t;
+
+/**
+ * @brief Connection tracking state
+ */
+static struct {
+    bool initialized;
+    bool enabled;
+    spinlock_t lock;                /* Serializes configuration */
+    spinlock_t shared_lock;         /* Serializes the table of the non-workers */
+    uint32_t handle;                /* Connection tracking stage */
+    uint32_t generation;            /* Bumped by conntrack_flush() */
+    ct_rules_t *rules;              /* NAT rules (RCU) */
+    ct_table_t *tables[CONNTRACK_MAX_WORKERS + 1]; /* By worker, then CT_SHARED_TABLE */
+    stats_shard_set_t *counters;    /* CT_CTR_COUNT counters */
+} g_ct = {0};
+
+static void ct_rules_free(rcu_head_t *head) {
+    mem_free(MEM_TAG_CONNTRACK, head);
+}
+
+static inline uint32_t ct_now(void) {
+    return (uint32_t)(sim_clock_now_us() / 1000000);
+}
+
+static inline uint32_t ct_hash(const ct_key_t *key) {
+    return (uint32_t)keyed_hash_bytes(key, sizeof(*key));
+}
+
+static inline ct_flow_t *ct_ref_flow(const ct_table_t *table, uint32_t ref) {
+    return &table->flows[(ref - 1) >> 1];
+}
+
+static inline uint32_t ct_ref_dir(uint32_t ref) {
+    return (ref - 1) & 1;
+}
+
+/**
+ * @brief Key of the other direction of a connection that is not translated
+ */
+static inline void ct_key_reverse(const ct_key_t *key, ct_key_t *out) {
+    memset(out, 0, sizeof(*out));
+    out->src = key->dst;
+    out->dst = key->src;
+    out->protocol = key->protocol;
+    if (key->protocol == IP_PROTO_ICMP) {
+        out->src_port = key->src_port;
+    } else {
+        out->src_port = key->dst_port;
+        out->dst_port = key->src_port;
+    }
+}
+
+/* ==================== Checksums ==================== */
+
+static inline uint32_t ct_csum_diff16(uint32_t sum, uint16_t old_word, uint16_t new_word) {
+    return sum + (uint16_t)~old_word + new_word;
+}
+
+static inline uint32_t ct_csum_diff32(uint32_t sum, uint32_t old_value, uint32_t new_value) {
+    uint32_t o = ntohl(old_value), n = ntohl(new_value);
+
+    sum = ct_csum_diff16(sum, (uint16_t)(o >> 16), (uint16_t)(n >> 16));
+    return ct_csum_diff16(sum, (uint16_t)o, (uint16_t)n);
+}
+
+static inline uint16_t ct_csum_reduce(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+/**
+ * @brief Patch a checksum field with a precomputed sum (RFC 1624, HC' = ~(~HC + m' - m))
+ */
+static inline void ct_csum_patch(uint8_t *field, uint16_t adjust) {
+    uint16_t csum = (uint16_t)(field[0] << 8 | field[1]);
+
+    csum = (uint16_t)~ct_csum_reduce((uint32_t)(uint16_t)~csum + adjust);
+    field[0] = (uint8_t)(csum >> 8);
+    field[1] = (uint8_t)csum;
+}
+
+/**
+ * @brief Work out the checksum sums of both directions
+ */
+static void ct_flow_set_adjust(ct_flow_t *flow) {
+    for (uint32_t dir = 0; dir < 2; dir++) {
+        const ct_key_t *from = &flow->key[dir];
+        ct_key_t to;
+        uint32_t ip = 0, l4;
+
+        ct_key_reverse(&flow->key[!dir], &to);
+        ip = ct_csum_diff32(ip, from->src, to.src);
+        ip = ct_csum_diff32(ip, from->dst, to.dst);
+        if (from->protocol == IP_PROTO_ICMP) {
+            // No pseudo header
+            l4 = ct_csum_diff16(0, ntohs(from->src_port), ntohs(to.src_port));
+        } else {
+            l4 = ct_csum_diff16(ip, ntohs(from->src_port), ntohs(to.src_port));
+            l4 = ct_csum_diff16(l4, ntohs(from->dst_port), ntohs(to.dst_port));
+        }
+        flow->ip_adjust[dir] = ct_csum_reduce(ip);
+        flow->l4_adjust[dir] = ct_csum_reduce(l4);
+    }
+}
+
+/* ==================== Tables ==================== */
+
+static void ct_table_destroy(ct_table_t *table) {
+    if (!table) {
+        return;
+    }
+    ring_destroy(table->mirror_queue);
+    ring_destroy(table->mirror_free);
+    mem_free(MEM_TAG_CONNTRACK, table->mirrors);
+    mem_free(MEM_TAG_CONNTRACK, table->flows);
+    mem_free(MEM_TAG_CONNTRACK, table->free_stack);
+    mem_free(MEM_TAG_CONNTRACK, table->buckets);
+    mem_free(MEM_TAG_CONNTRACK, table);
+}
+
+static ct_table_t *ct_table_create(void) {
+    ct_table_t *table = mem_calloc(MEM_TAG_CONNTRACK, 1, sizeof(*table));
+    uint32_t buckets = 1;
+
+    if (!table) {
+        return NULL;
+    }
+    while (buckets < 2u * CONFIG_CONNTRACK_FLOWS_PER_WORKER) {
+        buckets <<= 1;
+    }
+
+    // Zeroed pages: the flows are only backed by memory as they are used
+    table->buckets = mem_calloc(MEM_TAG_CONNTRACK, buckets, sizeof(*table->buckets));
+    table->flows = mem_calloc(MEM_TAG_CONNTRACK, CONFIG_CONNTRACK_FLOWS_PER_WORKER, sizeof(*table->flows));
+    table->free_stack = mem_malloc(MEM_TAG_CONNTRACK, CONFIG_CONNTRACK_FLOWS_PER_WORKER * sizeof(*table->free_stack));
+    table->mirrors = mem_calloc(MEM_TAG_CONNTRACK, CT_MIRROR_QUEUE, sizeof(*table->mirrors));
+    table->mirror_queue = ring_create(CT_MIRROR_QUEUE, RING_F_SC_DEQ);
+    table->mirror_free = ring_create(CT_MIRROR_QUEUE, RING_F_SP_ENQ);
+    if (!table->buckets || !table->flows || !table->free_stack || !table->mirrors ||
+        !table->mirror_queue || !table->mirror_free) {
+        ct_table_destroy(table);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < CT_MIRROR_QUEUE; i++) {
+        ring_enqueue(table->mirror_free, &table->mirrors[i]);
+    }
+
+    table->mask = buckets - 1;
+    table->generation = __atomic_load_n(&g_ct.generation, __ATOMIC_ACQUIRE);
+    table->wheel_time = ct_now();
+    return table;
+}
+
+/**
+ * @brief Get the table of a worker, creating it on first use
+ *
+ * Any thread may create the table, as a sender of a reply copy; only the
+ * owner changes it afterwards.
+ */
+static ct_table_t *ct_table_get(uint32_t slot) {
+    ct_table_t *table = __atomic_load_n(&g_ct.tables[slot], __ATOMIC_ACQUIRE);
+    ct_table_t *expected = NULL;
+
+    if (table) {
+        return table;
+    }
+    table = ct_table_create();
+    if (!table) {
+        return NULL;
+    }
+    if (!__atomic_compare_exchange_n(&g_ct.tables[slot], &expected, table, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        ct_table_destroy(table);
+        return expected;
+    }
+    return table;
+}
+
+/**
+ * @brief Empty a table after conntrack_flush()
+ */
+static void ct_table_reset(ct_table_t *table, uint32_t generation) {
+    memset(table->buckets, 0, ((size_t)table->mask + 1) * sizeof(*table->buckets));
+    memset(table->wheel, 0, sizeof(table->wheel));
+    table->used = 0;
+    table->free_top = 0;
+    table->wheel_time = ct_now();
+    table->generation = generation;
+    __atomic_store_n(&table->count, 0, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t ct_lookup(const ct_table_t *table, const ct_key_t *key, uint32_t hash) {
+    uint32_t ref = table->buckets[hash & table->mask];
+
+    while (ref) {
+        const ct_flow_t *flow = ct_ref_flow(table, ref);
+        uint32_t dir = ct_ref_dir(ref);
+
+        if (flow->hash[dir] == hash && memcmp(&flow->key[dir], key, sizeof(*key)) == 0) {
+            return ref;
+        }
+        ref = flow->chain[dir];
+    }
+    return 0;
+}
+
+static inline void ct_link_key(ct_table_t *table, uint32_t index, uint32_t dir) {
+    ct_flow_t *flow = &table->flows[index];
+    uint32_t *head = &table->buckets[flow->hash[dir] & table->mask];
+
+    flow->chain[dir] = *head;
+    *head = (index << 1 | dir) + 1;
+}
+
+static void ct_unlink_key(ct_table_t *table, uint32_t index, uint32_t dir) {
+    ct_flow_t *flow = &table->flows[index];
+    uint32_t ref = (index << 1 | dir) + 1;
+    uint32_t *link = &table->buckets[flow->hash[dir] & table->mask];
+
+    while (*link && *link != ref) {
+        link = &ct_ref_flow(table, *link)->chain[ct_ref_dir(*link)];
+    }
+    if (*link) {
+        *link = flow->chain[dir];
+    }
+}
+
+/**
+ * @brief Whether the key of a direction is in the hash
+ */
+static inline bool ct_keyed(const ct_flow_t *flow, uint32_t dir) {
+    return !(flow->flags & (dir == CT_DIR_ORIG ? CT_F_MIRROR : CT_F_REMOTE));
+}
+
+/* ==================== Timer wheel ==================== */
+
+static void ct_wheel_link(ct_table_t *table, uint32_t index, uint32_t when) {
+    ct_flow_t *flow = &table->flows[index];
+    uint32_t *head = &table->wheel[when & (CT_WHEEL_SLOTS - 1)];
+
+    flow->slot_time = when;
+    flow->wheel_prev = 0;
+    flow->wheel_next = *head;
+    if (*head) {
+        table->flows[*head - 1].wheel_prev = index + 1;
+    }
+    *head = index + 1;
+}
+
+static void ct_wheel_unlink(ct_table_t *table, uint32_t index) {
+    ct_flow_t *flow = &table->flows[index];
+
+    if (flow->wheel_prev) {
+        table->flows[flow->wheel_prev - 1].wheel_next = flow->wheel_next;
+    } else {
+        table->wheel[flow->slot_time & (CT_WHEEL_SLOTS - 1)] = flow->wheel_next;
+    }
+    if (flow->wheel_next) {
+        table->flows[flow->wheel_next - 1].wheel_prev = flow->wheel_prev;
+    }
+}
+
+/**
+ * @brief Second of the slot a deadline goes to, seen from second base
+ *
+ * Deadlines beyond one turn of the wheel wait in the last slot of the
+ * turn and move on from there.
+ */
+static inline uint32_t ct_wheel_when(uint32_t base, uint32_t expires) {
+    return expires - base < CT_WHEEL_SLOTS ? expires : base + CT_WHEEL_SLOTS - 1;
+}
+
+/**
+ * @brief Move the deadline of a connection
+ *
+ * An extended deadline is found by the sweep; only a deadline earlier
+ * than the connection's slot moves it.
+ */
+static inline void ct_set_expiry(ct_table_t *table, uint32_t index, uint32_t now, uint32_t timeout) {
+    ct_flow_t *flow = &table->flows[index];
+
+    flow->expires = now + timeout;
+    if ((int32_t)(flow->expires - flow->slot_time) < 0) {
+        ct_wheel_unlink(table, index);
+        ct_wheel_link(table, index, ct_wheel_when(now, flow->expires));
+    }
+}
+
+static inline uint32_t ct_flow_alloc(ct_table_t *table) {
+    if (table->free_top > 0) {
+        return table->free_stack[--table->free_top];
+    }
+    if (table->used < CONFIG_CONNTRACK_FLOWS_PER_WORKER) {
+        return table->used++;
+    }
+    return UINT32_MAX;
+}
+
+static void ct_flow_free(ct_table_t *table, uint32_t index) {
+    ct_flow_t *flow = &table->flows[index];
+
+    for (uint32_t dir = 0; dir < 2; dir++) {
+        if (ct_keyed(flow, dir)) {
+            ct_unlink_key(table, index, dir);
+        }
+    }
+    ct_wheel_unlink(table, index);
+    table->free_stack[table->free_top++] = index;
+    __atomic_store_n(&table->count, table->count - 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Hash in and start the timeout of a connection whose keys are set
+ */
+static void ct_flow_insert(ct_table_t *table, uint32_t index, uint32_t now, uint32_t timeout) {
+    ct_flow_t *flow = &table->flows[index];
+
+    for (uint32_t dir = 0; dir < 2; dir++) {
+        if (ct_keyed(flow, dir)) {
+            flow->hash[dir] = ct_hash(&flow->key[dir]);
+            ct_link_key(table, index, dir);
+        }
+    }
+    flow->expires = now + timeout;
+    ct_wheel_link(table, index, ct_wheel_when(now, flow->expires));
+    __atomic_store_n(&table->count, table->count + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Expire the connections of the slots up to now, within the budget
+ */
+static void ct_sweep(ct_table_t *table, uint32_t now, uint64_t *ctr) {
+    uint32_t budget = CT_SWEEP_BUDGET;
+
+    // Every slot is looked at once after a long pause
+    if (now - table->wheel_time > CT_WHEEL_SLOTS) {
+        table->wheel_time = now - CT_WHEEL_SLOTS;
+    }
+
+    while ((int32_t)(now - table->wheel_time) > 0) {
+        uint32_t second = table->wheel_time + 1;
+        uint32_t *head = &table->wheel[second & (CT_WHEEL_SLOTS - 1)];
+
+        for (; *head && budget > 0; budget--) {
+            uint32_t index = *head - 1;
+            ct_flow_t *flow = &table->flows[index];
+
+            if ((int32_t)(flow->expires - now) <= 0) {
+                ct_flow_free(table, index);
+                stats_shard_add(&ctr[CT_CTR_EXPIRED], 1);
+            } else {
+                ct_wheel_unlink(table, index);
+                ct_wheel_link(table, index, ct_wheel_when(second, flow->expires));
+            }
+        }
+        if (*head) {
+            return;
+        }
+        table->wheel_time = second;
+    }
+}
+
+/* ==================== Reply copies ==================== */
+
+static inline uint32_t ct_timeout(const ct_flow_t *flow) {
+    switch (flow->key[CT_DIR_ORIG].protocol) {
+        case IP_PROTO_TCP:
+            switch (flow->state) {
+                case CT_TCP_ESTABLISHED: return CONNTRACK_TCP_ESTABLISHED_TIMEOUT;
+                case CT_TCP_CLOSED:      return CONNTRACK_TCP_CLOSED_TIMEOUT;
+                default:                 return CONNTRACK_TCP_TRANSITORY_TIMEOUT;
+            }
+        case IP_PROTO_UDP:
+            return (flow->flags & CT_F_REPLIED) ? CONNTRACK_UDP_TIMEOUT : CONNTRACK_UDP_UNREPLIED_TIMEOUT;
+        default:
+            return CONNTRACK_ICMP_TIMEOUT;
+    }
+}
+
+/**
+ * @brief Send the worker replies hash to a copy of a connection
+ */
+static void ct_mirror_send(ct_flow_t *flow, uint32_t generation, uint32_t now, uint64_t *ctr) {
+    ct_table_t *peer = ct_table_get(flow->mirror_worker);
+    void *obj;
+
+    // Sent again at the next packet after half the timeout either way
+    flow->mirror_sent = now;
+    flow->mirror_timeout = (uint16_t)ct_timeout(flow);
+
+    // The queue holds every request, so one taken always fits
+    if (!peer || !ring_dequeue(peer->mirror_free, &obj)) {
+        stats_shard_add(&ctr[CT_CTR_MIRROR_DROPS], 1);
+        return;
+    }
+    ct_mirror_t *mirror = obj;
+    mirror->generation = generation;
+    mirror->timeout = flow->mirror_timeout;
+    mirror->flags = flow->flags & (CT_F_SNAT | CT_F_DNAT);
+    mirror->key[CT_DIR_ORIG] = flow->key[CT_DIR_ORIG];
+    mirror->key[CT_DIR_REPLY] = flow->key[CT_DIR_REPLY];
+    ring_enqueue(peer->mirror_queue, mirror);
+    stats_shard_add(&ctr[CT_CTR_MIRRORS_SENT], 1);
+}
+
+/**
+ * @brief Install or refresh the reply copies queued to a table
+ */
+static void ct_mirror_receive(ct_table_t *table, uint32_t now, uint64_t *ctr) {
+    void *objs[CT_MIRROR_BURST];
+    uint32_t n = ring_dequeue_burst(table->mirror_queue, objs, CT_MIRROR_BURST);
+
+    for (uint32_t i = 0; i < n; i++) {
+        const ct_mirror_t *mirror = objs[i];
+        uint32_t hash, ref, index;
+
+        // Sent before a flush
+        if (mirror->generation != table->generation) {
+            continue;
+        }
+
+        hash = ct_hash(&mirror->key[CT_DIR_REPLY]);
+        ref = ct_lookup(table, &mirror->key[CT_DIR_REPLY], hash);
+        if (ref) {
+            ct_flow_t *flow = ct_ref_flow(table, ref);
+
+            if ((flow->flags & CT_F_MIRROR) &&
+                memcmp(&flow->key[CT_DIR_ORIG], &mirror->key[CT_DIR_ORIG], sizeof(ct_key_t)) == 0) {
+                ct_set_expiry(table, (ref - 1) >> 1, now, mirror->timeout);
+            } else {
+                stats_shard_add(&ctr[CT_CTR_MIRROR_DROPS], 1);
+            }
+            continue;
+        }
+
+        index = ct_flow_alloc(table);
+        if (index == UINT32_MAX) {
+            stats_shard_add(&ctr[CT_CTR_MIRROR_DROPS], 1);
+            continue;
+        }
+        ct_flow_t *flow = &table->flows[index];
+        memset(flow, 0, sizeof(*flow));
+        flow->key[CT_DIR_ORIG] = mirror->key[CT_DIR_ORIG];
+        flow->key[CT_DIR_REPLY] = mirror->key[CT_DIR_REPLY];
+        flow->flags = CT_F_MIRROR | CT_F_REPLIED | mirror->flags;
+        flow->state = CT_TCP_ESTABLISHED;
+        ct_flow_set_adjust(flow);
+        ct_flow_insert(table, index, now, mirror->timeout);
+    }
+    if (n > 0) {
+        ring_enqueue_burst(table->mirror_free, objs, n);
+    }
+}
+
+/* ==================== NAT ==================== */
+
+static inline bool ct_rule_matches(const conntrack_nat_rule_t *rule, const ct_key_t *key) {
+    uint32_t mask = rule->match_prefix_len ? htonl(~0u << (32 - rule->match_prefix_len)) : 0;
+    ipv4_addr_t addr = rule->type == CONNTRACK_NAT_SNAT ? key->src : key->dst;
+
+    if (rule->protocol && rule->protocol != key->protocol) {
+        return false;
+    }
+    if ((addr & mask) != rule->match_addr) {
+        return false;
+    }
+    if (rule->type == CONNTRACK_NAT_DNAT && rule->match_port &&
+        (key->protocol == IP_PROTO_ICMP || ntohs(key->dst_port) != rule->match_port)) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Whether replies with this key reach the calling worker
+ */
+static inline bool ct_reply_here(uint32_t self, const ct_key_t *reply) {
+    if (self == UINT32_MAX) {
+        return true;
+    }
+    uint32_t hash = packet_flow_hash_ipv4(reply->src, reply->dst, reply->protocol,
+                                          reply->src_port, reply->dst_port);
+    return forwarding_worker_for_hash(hash) == self;
+}
+
+/**
+ * @brief Try a source binding: free in the table and steering replies here
+ */
+static inline bool ct_snat_try(const ct_table_t *table, uint32_t self, ct_key_t *reply,
+                               ipv4_addr_t addr, uint16_t port) {
+    reply->dst = addr;
+    if (reply->protocol == IP_PROTO_ICMP) {
+        reply->src_port = htons(port);
+    } else {
+        reply->dst_port = htons(port);
+    }
+    return ct_reply_here(self, reply) && ct_lookup(table, reply, ct_hash(reply)) == 0;
+}
+
+/**
+ * @brief Choose the source address and port of a connection
+ *
+ * The address is the same for every connection of an internal host
+ * (paired pooling, RFC 4787 REQ-2). The original port is kept if it is in
+ * range and some address makes replies land here; otherwise ports are
+ * taken from a point given by the flow until one does.
+ *
+ * @return true with the reply key set, false if no binding was found
+ */
+static bool ct_snat_choose(const ct_table_t *table, uint32_t self, const conntrack_nat_rule_t *rule,
+                           const ct_key_t *orig, uint32_t flow_hash, ct_key_t *reply) {
+    uint32_t addr_min = ntohl(rule->nat_addr_min);
+    uint32_t naddr = ntohl(rule->nat_addr_max) - addr_min + 1;
+    uint32_t port_min = rule->nat_port_min ? rule->nat_port_min : CT_NAT_PORT_MIN;
+    uint32_t port_max = rule->nat_port_min ? rule->nat_port_max : CT_NAT_PORT_MAX;
+    uint32_t nports = port_max - port_min + 1;
+    uint32_t workers = forwarding_get_worker_count();
+    uint32_t attempts = CT_NAT_ATTEMPTS * (workers ? workers : 1);
+    uint32_t base = (uint32_t)(keyed_hash_u64(orig->src) % naddr);
+    uint16_t port = ntohs(orig->src_port);
+
+    ct_key_reverse(orig, reply);
+
+    if (!rule->nat_port_min || (port >= port_min && port <= port_max)) {
+        for (uint32_t i = 0; i < naddr && i < attempts; i++) {
+            if (ct_snat_try(table, self, reply, htonl(addr_min + (base + i) % naddr), port)) {
+                return true;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < attempts; i++) {
+        uint32_t addr = addr_min + (base + (flow_hash % nports + i) / nports) % naddr;
+
+        port = (uint16_t)(port_min + (flow_hash + i) % nports);
+        if (ct_snat_try(table, self, reply, htonl(addr), port)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Choose the destination of a connection, spread over the range by flow
+ */
+static void ct_dnat_choose(const conntrack_nat_rule_t *rule, const ct_key_t *orig, uint32_t flow_hash,
+                           ct_key_t *reply) {
+    uint32_t addr_min = ntohl(rule->nat_addr_min);
+    uint32_t naddr = ntohl(rule->nat_addr_max) - addr_min + 1;
+    ct_key_t translated = *orig;
+
+    translated.dst = htonl(addr_min + flow_hash % naddr);
+    if (rule->nat_port_min && orig->protocol != IP_PROTO_ICMP) {
+        translated.dst_port = htons(rule->nat_port_min);
+    }
+    ct_key_reverse(&translated, reply);
+}
+
+/* ==================== Stage ==================== */
+
+/**
+ * @brief Key of a packet the stage tracks
+ *
+ * @return 1 if tracked, 0 if not routed here, -1 if routed but untracked
+ */
+static int ct_packet_key(packet_buffer_t *packet, port_id_t *mac_port, mac_addr_t *mac, ct_key_t *key,
+                         uint8_t *tcp_flags) {
+    const packet_metadata_t *md = &packet->metadata;
+
+    if (packet_ensure_parsed(packet) != STATUS_SUCCESS || !packet_has_proto(packet, PACKET_PROTO_IPV4) ||
+        md->l3_offset < CT_ETH_HLEN) {
+        return 0;
+    }
+    if (*mac_port != md->port) {
+        if (port_get_mac(md->port, mac) != STATUS_SUCCESS) {
+            return 0;
+        }
+        *mac_port = md->port;
+    }
+    if (memcmp(packet->data, mac->addr, MAC_ADDR_LEN) != 0) {
+        return 0;
+    }
+
+    const uint8_t *l3 = packet_l3_header(packet);
+    const uint8_t *l4 = packet_l4_header(packet);
+    uint32_t l4_len = packet->size > md->l4_offset ? packet->size - md->l4_offset : 0;
+
+    if (l3[16] >= 0xE0 || !packet_parsed_has(packet, PACKET_PARSED_L4) ||
+        packet_has_proto(packet, PACKET_PROTO_IP_FRAG)) {
+        return -1;
+    }
+
+    memset(key, 0, sizeof(*key));
+    memcpy(&key->src, l3 + 12, sizeof(key->src));
+    memcpy(&key->dst, l3 + 16, sizeof(key->dst));
+    key->protocol = l3[9];
+    *tcp_flags = 0;
+    switch (key->protocol) {
+        case IP_PROTO_TCP:
+            if (l4_len < CT_TCP_HLEN) {
+                return -1;
+            }
+            *tcp_flags = l4[13];
+            break;
+        case IP_PROTO_UDP:
+            if (l4_len < CT_UDP_HLEN) {
+                return -1;
+            }
+            break;
+        case IP_PROTO_ICMP:
+            if (l4_len < CT_ICMP_HLEN || (l4[0] != CT_ICMP_ECHO_REQUEST && l4[0] != CT_ICMP_ECHO_REPLY)) {
+                return -1;
+            }
+            memcpy(&key->src_port, l4 + 4, sizeof(key->src_port));
+            return 1;
+        default:
+            return -1;
+    }
+    memcpy(&key->src_port, l4, sizeof(key->src_port));
+    memcpy(&key->dst_port, l4 + 2, sizeof(key->dst_port));
+    return 1;
+}
+
+/**
+ * @brief Create the connection of a packet whose key is in no table
+ *
+ * @return Reference of the original direction, 0 if the packet must be dropped
+ */
+static uint32_t ct_flow_create(ct_table_t *table, uint32_t self, const ct_rules_t *rules,
+                               const ct_key_t *key, uint32_t hash, uint32_t now, uint64_t *ctr) {
+    const conntrack_nat_rule_t *rule = NULL;
+    ct_key_t reply;
+    uint8_t flags = 0;
+    uint32_t index;
+
+    for (uint32_t i = 0; rules && i < rules->count; i++) {
+        if (ct_rule_matches(&rules->rule[i], key)) {
+            rule = &rules->rule[i];
+            break;
+        }
+    }
+
+    if (rule && rule->type == CONNTRACK_NAT_SNAT) {
+        if (!ct_snat_choose(table, self, rule, key, hash, &reply)) {
+            stats_shard_add(&ctr[CT_CTR_NAT_EXHAUSTED], 1);
+            return 0;
+        }
+        flags = CT_F_SNAT;
+    } else {
+        if (rule) {
+            ct_dnat_choose(rule, key, hash, &reply);
+            flags = CT_F_DNAT;
+        } else {
+            ct_key_reverse(key, &reply);
+        }
+        // Replies of a translated destination may hash anywhere
+        if (!ct_reply_here(self, &reply)) {
+            flags |= CT_F_REMOTE | CT_F_REPLIED;
+        } else if (ct_lookup(table, &reply, ct_hash(&reply)) != 0) {
+            stats_shard_add(&ctr[CT_CTR_NAT_EXHAUSTED], 1);
+            return 0;
+        }
+    }
+
+    index = ct_flow_alloc(table);
+    if (index == UINT32_MAX) {
+        stats_shard_add(&ctr[CT_CTR_TABLE_FULL], 1);
+        return 0;
+    }
+
+    ct_flow_t *flow = &table->flows[index];
+    memset(flow, 0, sizeof(*flow));
+    flow->key[CT_DIR_ORIG] = *key;
+    flow->key[CT_DIR_REPLY] = reply;
+    flow->flags = flags;
+    flow->state = CT_TCP_SYN_SENT;
+    if (flags & (CT_F_SNAT | CT_F_DNAT)) {
+        ct_flow_set_adjust(flow);
+        stats_shard_add(&ctr[(flags & CT_F_SNAT) ? CT_CTR_SNAT : CT_CTR_DNAT], 1);
+    }
+    ct_flow_insert(table, index, now, ct_timeout(flow));
+    stats_shard_add(&ctr[CT_CTR_CREATED], 1);
+
+    if (flags & CT_F_REMOTE) {
+        uint32_t worker = forwarding_worker_for_hash(
+            packet_flow_hash_ipv4(reply.src, reply.dst, reply.protocol, reply.src_port, reply.dst_port));
+
+        flow->mirror_worker = (uint8_t)(worker < CONNTRACK_MAX_WORKERS ? worker : CT_SHARED_TABLE);
+        ct_mirror_send(flow, table->generation, now, ctr);
+    }
+    return (index << 1 | CT_DIR_ORIG) + 1;
+}
+
+/**
+ * @brief Follow the TCP flags of a packet
+ */
+static inline void ct_tcp_update(ct_flow_t *flow, uint32_t dir, uint8_t tcp_flags) {
+    if (tcp_flags & CT_TCP_RST) {
+        flow->state = CT_TCP_CLOSED;
+        return;
+    }
+    if (tcp_flags & CT_TCP_FIN) {
+        flow->flags |= dir == CT_DIR_ORIG ? CT_F_FIN_ORIG : CT_F_FIN_REPLY;
+        if ((flow->flags & (CT_F_FIN_ORIG | CT_F_FIN_REPLY)) == (CT_F_FIN_ORIG | CT_F_FIN_REPLY)) {
+            flow->state = CT_TCP_CLOSED;
+        } else if (flow->state != CT_TCP_CLOSED) {
+            flow->state = CT_TCP_CLOSING;
+        }
+        return;
+    }
+
+    switch (flow->state) {
+        case CT_TCP_SYN_SENT:
+            // The answer, or the last ACK of a handshake whose answer went elsewhere
+            if (dir == CT_DIR_REPLY || ((tcp_flags & CT_TCP_ACK) && !(tcp_flags & CT_TCP_SYN))) {
+                flow->state = CT_TCP_ESTABLISHED;
+            }
+            break;
+        case CT_TCP_CLOSED:
+            // The ports are taken again
+            if (dir == CT_DIR_ORIG && (tcp_flags & (CT_TCP_SYN | CT_TCP_ACK)) == CT_TCP_SYN) {
+                flow->state = CT_TCP_SYN_SENT;
+                flow->flags &= (uint8_t)~(CT_F_FIN_ORIG | CT_F_FIN_REPLY);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Rewrite the addresses, ports and checksums of a packet
+ *
+ * @return false if the packet could not be made writable
+ */
+static bool ct_translate(packet_buffer_t *packet, const ct_flow_t *flow, uint32_t dir) {
+    ct_key_t to;
+
+    if (packet_make_writable(packet) != STATUS_SUCCESS) {
+        return false;
+    }
+
+    // Writable data may have moved
+    uint8_t *l3 = packet_l3_header(packet);
+    uint8_t *l4 = packet_l4_header(packet);
+    uint16_t offload = packet->metadata.offload;
+
+    ct_key_reverse(&flow->key[!dir], &to);
+    memcpy(l3 + 12, &to.src, sizeof(to.src));
+    memcpy(l3 + 16, &to.dst, sizeof(to.dst));
+    if (!(offload & PACKET_OFFLOAD_IP_CSUM)) {
+        ct_csum_patch(l3 + 10, flow->ip_adjust[dir]);
+    }
+
+    switch (to.protocol) {
+        case IP_PROTO_TCP:
+            memcpy(l4, &to.src_port, sizeof(to.src_port));
+            memcpy(l4 + 2, &to.dst_port, sizeof(to.dst_port));
+            if (!(offload & PACKET_OFFLOAD_L4_CSUM)) {
+                ct_csum_patch(l4 + 16, flow->l4_adjust[dir]);
+            }
+            break;
+        case IP_PROTO_UDP:
+            memcpy(l4, &to.src_port, sizeof(to.src_port));
+            memcpy(l4 + 2, &to.dst_port, sizeof(to.dst_port));
+            // A zero checksum was not computed, and a computed zero is sent as 0xFFFF
+            if (!(offload & PACKET_OFFLOAD_L4_CSUM) && (l4[6] | l4[7])) {
+                ct_csum_patch(l4 + 6, flow->l4_adjust[dir]);
+                if ((l4[6] | l4[7]) == 0) {
+                    l4[6] = l4[7] = 0xFF;
+                }
+            }
+            break;
+        default:
+            memcpy(l4 + 4, &to.src_port, sizeof(to.src_port));
+            ct_csum_patch(l4 + 2, flow->l4_adjust[dir]);
+            break;
+    }
+    return true;
+}
+
+/**
+ * @brief Connection tracking stage
+ *
+ * Works in passes over the burst: keys, hashes and bucket prefetches;
+ * lookups; creation of the connections missing; then state, timeout and
+ * translation of every tracked packet.
+ */
+static void ct_stage_burst(packet_buffer_t **pkts, uint32_t count, packet_result_t *results,
+                           void *user_data) {
+    ct_key_t keys[PACKET_BURST_MAX];
+    uint32_t hashes[PACKET_BURST_MAX];
+    uint32_t refs[PACKET_BURST_MAX];
+    uint8_t tcp_flags[PACKET_BURST_MAX];
+    uint8_t tracked[PACKET_BURST_MAX];
+    port_id_t mac_port = PORT_ID_INVALID;
+    mac_addr_t mac;
+    uint32_t misses = 0, n = 0;
+
+    (void)user_data;
+    for (uint32_t i = 0; i < count; i++) {
+        results[i] = PACKET_RESULT_FORWARD;
+    }
+    if (!__atomic_load_n(&g_ct.enabled, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    uint32_t self = forwarding_current_worker();
+    uint32_t slot = self < CONNTRACK_MAX_WORKERS ? self : CT_SHARED_TABLE;
+    uint64_t *ctr = stats_shard_local(g_ct.counters);
+    ct_table_t *table = ct_table_get(slot);
+
+    if (!ctr || !table) {
+        return;
+    }
+    if (slot == CT_SHARED_TABLE) {
+        self = UINT32_MAX;
+        spinlock_acquire(&g_ct.shared_lock);
+    }
+
+    uint32_t generation = __atomic_load_n(&g_ct.generation, __ATOMIC_ACQUIRE);
+    uint32_t now = ct_now();
+
+    if (table->generation != generation) {
+        ct_table_reset(table, generation);
+    }
+    ct_mirror_receive(table, now, ctr);
+    ct_sweep(table, now, ctr);
+
+    // Pass 1: keys and hashes, buckets fetched ahead
+    for (uint32_t i = 0; i < count; i++) {
+        int rc = ct_packet_key(pkts[i], &mac_port, &mac, &keys[i], &tcp_flags[i]);
+
+        tracked[i] = rc > 0;
+        if (rc < 0) {
+            stats_shard_add(&ctr[CT_CTR_UNTRACKED], 1);
+        }
+        if (rc > 0) {
+            hashes[i] = ct_hash(&keys[i]);
+            __builtin_prefetch(&table->buckets[hashes[i] & table->mask]);
+            n++;
+        }
+    }
+
+    // Pass 2: lookups, connections fetched ahead
+    for (uint32_t i = 0; n > 0 && i < count; i++) {
+        if (!tracked[i]) {
+            continue;
+        }
+        refs[i] = ct_lookup(table, &keys[i], hashes[i]);
+        if (refs[i]) {
+            __builtin_prefetch(ct_ref_flow(table, refs[i]));
+        } else {
+            misses++;
+        }
+    }
+
+    // Pass 3: the new connections, under one read of the rules
+    if (misses > 0) {
+        bool locked = rcu_read_lock() == STATUS_SUCCESS;
+        const ct_rules_t *rules = locked ? __atomic_load_n(&g_ct.rules, __ATOMIC_ACQUIRE) : NULL;
+
+        for (uint32_t i = 0; i < count; i++) {
+            if (!tracked[i] || refs[i]) {
+                continue;
+            }
+            // An earlier packet of the burst may have opened it
+            refs[i] = ct_lookup(table, &keys[i], hashes[i]);
+            if (!refs[i]) {
+                refs[i] = ct_flow_create(table, self, rules, &keys[i], hashes[i], now, ctr);
+            }
+            if (!refs[i]) {
+                packet_drop_count(pkts[i], PACKET_DROP_CONNTRACK);
+                results[i] = PACKET_RESULT_DROP;
+                tracked[i] = 0;
+            }
+        }
+        if (locked) {
+            rcu_read_unlock();
+        }
+    }
+
+    // Pass 4: state, timeout and translation
+    for (uint32_t i = 0; n > 0 && i < count; i++) {
+        if (!tracked[i]) {
+            continue;
+        }
+        uint32_t index = (refs[i] - 1) >> 1;
+        uint32_t dir = ct_ref_dir(refs[i]);
+        ct_flow_t *flow = &table->flows[index];
+
+        // A reply copy lives as long as its sender keeps refreshing it
+        if (!(flow->flags & CT_F_MIRROR)) {
+            if (dir == CT_DIR_REPLY) {
+                flow->flags |= CT_F_REPLIED;
+            }
+            if (keys[i].protocol == IP_PROTO_TCP) {
+                ct_tcp_update(flow, dir, tcp_flags[i]);
+            }
+            ct_set_expiry(table, index, now, ct_timeout(flow));
+            if ((flow->flags & CT_F_REMOTE) &&
+                (ct_timeout(flow) != flow->mirror_timeout ||
+                 2 * (now - flow->mirror_sent) >= flow->mirror_timeout)) {
+                ct_mirror_send(flow, generation, now, ctr);
+            }
+        }
+
+        if (flow->flags & (CT_F_SNAT | CT_F_DNAT)) {
+            if (!ct_translate(pkts[i], flow, dir)) {
+                packet_drop_count(pkts[i], PACKET_DROP_INTERNAL);
+                results[i] = PACKET_RESULT_DROP;
+                continue;
+            }
+            stats_shard_add(&ctr[CT_CTR_TRANSLATED], 1);
+        }
+    }
+
+    if (slot == CT_SHARED_TABLE) {
+        spinlock_release(&g_ct.shared_lock);
+    }
+}
+
+/* ==================== API ==================== */
+
+/**
+ * @brief Register the connection tracking stage
+ *
+ * @return status_t Status code
+ */
+status_t conntrack_init(void) {
+    status_t status;
+
+    if (g_ct.initialized) {
+        LOG_WARNING(LOG_CATEGORY_L3, "Conntrack: Already initialized");
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    keyed_hash_init();
+    status = stats_shard_create(CT_CTR_COUNT, &g_ct.counters);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Conntrack: Failed to create counters");
+        return status;
+    }
+
+    spinlock_init(&g_ct.lock);
+    spinlock_init(&g_ct.shared_lock);
+    g_ct.rules = NULL;
+    g_ct.enabled = false;
+    memset(g_ct.tables, 0, sizeof(g_ct.tables));
+    __atomic_store_n(&g_ct.initialized, true, __ATOMIC_RELEASE);
+
+    status = packet_register_burst_processor(ct_stage_burst, CONNTRACK_PROCESSOR_PRIORITY, NULL,
+                                             &g_ct.handle);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Conntrack: Failed to register the stage: %d", status);
+        __atomic_store_n(&g_ct.initialized, false, __ATOMIC_RELEASE);
+        stats_shard_destroy(g_ct.counters);
+        g_ct.counters = NULL;
+        return status;
+    }
+    packet_set_processor_name(g_ct.handle, "conntrack");
+
+    LOG_INFO(LOG_CATEGORY_L3, "Conntrack: Module initialized, %u connections per worker",
+             (uint32_t)CONFIG_CONNTRACK_FLOWS_PER_WORKER);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Unregister the stage and free the tables
+ *
+ * @return status_t Status code
+ */
+status_t conntrack_cleanup(void) {
+    if (!g_ct.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    packet_unregister_processor(g_ct.handle);
+    __atomic_store_n(&g_ct.enabled, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_ct.initialized, false, __ATOMIC_RELEASE);
+    rcu_synchronize();
+
+    for (uint32_t i = 0; i <= CONNTRACK_MAX_WORKERS; i++) {
+        ct_table_destroy(g_ct.tables[i]);
+        g_ct.tables[i] = NULL;
+    }
+    mem_free(MEM_TAG_CONNTRACK, g_ct.rules);
+    g_ct.rules = NULL;
+    stats_shard_destroy(g_ct.counters);
+    g_ct.counters = NULL;
+
+    LOG_INFO(LOG_CATEGORY_L3, "Conntrack: Module cleaned up");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Turn tracking on or off
+ *
+ * @param enabled true to track
+ * @return status_t Status code
+ */
+status_t conntrack_set_enabled(bool enabled) {
+    if (!g_ct.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    __atomic_store_n(&g_ct.enabled, enabled, __ATOMIC_RELEASE);
+    LOG_INFO(LOG_CATEGORY_L3, "Conntrack: Tracking %s", enabled ? "enabled" : "disabled");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Replace the published rules with a copy of the current ones and maybe one more
+ */
+static status_t ct_rules_publish(const conntrack_nat_rule_t *added) {
+    ct_rules_t *old = g_ct.rules;
+    uint32_t count = (old && added ? old->count : 0) + (added ? 1 : 0);
+    ct_rules_t *rules = NULL;
+
+    if (count > CONNTRACK_MAX_NAT_RULES) {
+        return STATUS_RESOURCE_EXHAUSTED;
+    }
+    if (count > 0) {
+        rules = mem_malloc(MEM_TAG_CONNTRACK, sizeof(*rules) + count * sizeof(rules->rule[0]));
+        if (!rules) {
+            return STATUS_NO_MEMORY;
+        }
+        rules->count = count;
+        if (count > 1) {
+            memcpy(rules->rule, old->rule, (count - 1) * sizeof(rules->rule[0]));
+        }
+        rules->rule[count - 1] = *added;
+    }
+
+    __atomic_store_n(&g_ct.rules, rules, __ATOMIC_RELEASE);
+    if (old) {
+        rcu_retire(&old->rcu, ct_rules_free);
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Append a NAT rule
+ *
+ * @param rule Rule
+ * @return status_t Status code
+ */
+status_t conntrack_add_nat_rule(const conntrack_nat_rule_t *rule) {
+    conntrack_nat_rule_t copy;
+    status_t status;
+
+    if (!g_ct.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!rule || (rule->type != CONNTRACK_NAT_SNAT && rule->type != CONNTRACK_NAT_DNAT) ||
+        (rule->protocol != 0 && rule->protocol != IP_PROTO_TCP && rule->protocol != IP_PROTO_UDP &&
+         rule->protocol != IP_PROTO_ICMP) ||
+        rule->match_prefix_len > 32 || rule->nat_addr_min == 0 ||
+        ntohl(rule->nat_addr_min) > ntohl(rule->nat_addr_max)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (rule->type == CONNTRACK_NAT_SNAT &&
+        (rule->nat_port_min ? rule->nat_port_max < rule->nat_port_min : rule->nat_port_max != 0)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    copy = *rule;
+    copy.match_addr &= rule->match_prefix_len ? htonl(~0u << (32 - rule->match_prefix_len)) : 0;
+
+    spinlock_acquire(&g_ct.lock);
+    status = ct_rules_publish(&copy);
+    spinlock_release(&g_ct.lock);
+
+    if (status == STATUS_SUCCESS) {
+        LOG_DEBUG(LOG_CATEGORY_L3, "Conntrack: %s rule added for /%u",
+                  rule->type == CONNTRACK_NAT_SNAT ? "SNAT" : "DNAT", rule->match_prefix_len);
+    }
+    return status;
+}
+
+/**
+ * @brief Remove every NAT rule
+ *
+ * @return status_t Status code
+ */
+status_t conntrack_clear_nat_rules(void) {
+    status_t status;
+
+    if (!g_ct.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    spinlock_acquire(&g_ct.lock);
+    status = ct_rules_publish(NULL);
+    spinlock_release(&g_ct.lock);
+    return status;
+}
+
+/**
+ * @brief Remove every connection
+ *
+ * @return status_t Status code
+ */
+status_t conntrack_flush(void) {
+    if (!g_ct.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    __atomic_add_fetch(&g_ct.generation, 1, __ATOMIC_ACQ_REL);
+    LOG_INFO(LOG_CATEGORY_L3, "Conntrack: Connections flushed");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get connection tracking counters
+ *
+ * @param stats Counters
+ * @return status_t Status code
+ */
+status_t conntrack_get_stats(conntrack_stats_t *stats) {
+    uint64_t ctr[CT_CTR_COUNT];
+
+    if (!g_ct.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    stats_shard_fold(g_ct.counters, 0, CT_CTR_COUNT, ctr);
+    stats->flows = 0;
+    for (uint32_t i = 0; i <= CONNTRACK_MAX_WORKERS; i++) {
+        const ct_table_t *table = __atomic_load_n(&g_ct.tables[i], __ATOMIC_ACQUIRE);
+
+        if (table) {
+            stats->flows += __atomic_load_n(&table->count, __ATOMIC_RELAXED);
+        }
+    }
+    stats->created = ctr[CT_CTR_CREATED];
+    stats->expired = ctr[CT_CTR_EXPIRED];
+    stats->table_full = ctr[CT_CTR_TABLE_FULL];
+    stats->snat = ctr[CT_CTR_SNAT];
+    stats->dnat = ctr[CT_CTR_DNAT];
+    stats->nat_exhausted = ctr[CT_CTR_NAT_EXHAUSTED];
+    stats->translated = ctr[CT_CTR_TRANSLATED];
+    stats->untracked = ctr[CT_CTR_UNTRACKED];
+    stats->mirrors_sent = ctr[CT_CTR_MIRRORS_SENT];
+    stats->mirror_drops = ctr[CT_CTR_MIRROR_DROPS];
+    return STATUS_SUCCESS;
+}
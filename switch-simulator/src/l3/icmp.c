@@ -0,0 +1,578 @@
+/**
+ * @file icmp.c
+ * @brief Implementation of ICMP and ICMPv6 error generation
+ *
+ * Error messages are produced in two halves. The forwarding worker that
+ * drops a datagram decides whether it may be answered at all, charges the
+ * source's token bucket, and copies the quoted part of the datagram behind
+ * a copy of the prebuilt reply header. The message then waits on the
+ * control-plane queue, where icmp_process_errors() fills in the addresses,
+ * lengths and checksums and hands it to IP output like any locally
+ * originated packet.
+ *
+ * The token buckets are GCRA cells like the ARP request limiter: one
+ * theoretical arrival time per bucket, updated with a compare-and-swap so
+ * workers never take a lock to be refused. Sources are hashed onto the
+ * buckets, IPv6 sources by their /64.
+ */
+
+#include "l3/icmp.h"
+#include "l3/ip.h"
+#include "l3/ip_processing.h"
+#include "common/logging.h"
+#include "common/error_codes.h"
+#include "common/threading.h"
+#include "hal/packet.h"
+#include "hal/packet_ring.h"
+#include "hal/port.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+/* Defines */
+#define ICMP_HEADER_LEN 8               /* Type, code, checksum and the 32-bit parameter */
+#define ICMP_V4_MESSAGE_MAX 576         /* Quote as much as fits here (RFC 1812 4.3.2.3) */
+#define ICMP_V6_MESSAGE_MAX 1280        /* The IPv6 minimum MTU (RFC 4443 2.4(c)) */
+#define ICMP_V4_QUOTE_MAX (ICMP_V4_MESSAGE_MAX - IPV4_HEADER_MIN_LEN - ICMP_HEADER_LEN)
+#define ICMP_V6_QUOTE_MAX (ICMP_V6_MESSAGE_MAX - IPV6_HEADER_LEN - ICMP_HEADER_LEN)
+#define ICMP_DEFAULT_TTL 64
+#define ICMP_BUCKET_COUNT 4096          /* Per-source buckets, a power of two */
+#define ICMP_NS_PER_SEC 1000000000ULL
+#define ICMPV6_ERROR_TYPE_MAX 127       /* ICMPv6 types below 128 are errors */
+#define ICMP_FRAG_OFFSET_MASK 0x1FFF
+
+#define ICMP_STAT_INC(field) __atomic_fetch_add(&g_icmp.stats.field, 1, __ATOMIC_RELAXED)
+
+/* Private data types */
+
+/* ICMP and ICMPv6 header */
+typedef struct {
+    uint8_t type;
+    uint8_t code;
+    uint16_t checksum;
+    uint32_t param;                 /* Next-hop MTU or unused, network order */
+} icmp_header_t;
+
+/* ICMP error engine state */
+typedef struct {
+    bool initialized;
+    uint64_t interval_ns;           /* Time one error costs a source, 0 if disabled */
+    uint64_t depth_ns;              /* Burst a quiet source may spend at once */
+    uint64_t buckets[ICMP_BUCKET_COUNT]; /* Theoretical arrival time of each bucket */
+    uint32_t hash_seed;
+    ipv4_header_t template_v4;      /* Reply header: everything but length, ID, destination, checksum */
+    ipv6_header_t template_v6;      /* Reply header: everything but length and destination */
+    uint16_t ident;                 /* IPv4 identification, control plane only */
+    spinlock_t queue_lock;          /* Serializes the workers producing into the queue */
+    packet_ring_t *queue;           /* Messages waiting for the control plane */
+    icmp_stats_t stats;
+} icmp_engine_t;
+
+/* Global variables */
+static icmp_engine_t g_icmp;
+
+/* Forward declarations of private functions */
+static uint64_t icmp_now_ns(void);
+static uint32_t icmp_hash_source(const void *key, size_t len);
+static bool icmp_bucket_take(uint64_t *bucket, uint64_t now);
+static bool icmp_ipv4_may_answer(const packet_buffer_t *packet, uint16_t l3_offset,
+                                 const ipv4_header_t *header);
+static bool icmp_ipv6_may_answer(const packet_buffer_t *packet, uint16_t l3_offset,
+                                 const ipv6_header_t *header, uint8_t type);
+static uint32_t icmp_sum(uint32_t sum, const uint8_t *data, size_t len);
+static uint16_t icmp_fold(uint32_t sum);
+static status_t icmp_finish(packet_buffer_t *msg);
+
+/**
+ * @brief Initialize the ICMP error engine
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t icmp_init(void) {
+    static const uint8_t default_v4[4] = {10, 0, 0, 1};
+    static const uint8_t default_v6[16] = {0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1};
+    ipv4_addr_t src_v4;
+    ipv6_addr_t src_v6;
+
+    if (g_icmp.initialized) {
+        return STATUS_SUCCESS;
+    }
+
+    memset(&g_icmp, 0, sizeof(g_icmp));
+    g_icmp.queue = packet_ring_create(ICMP_QUEUE_SIZE);
+    if (!g_icmp.queue) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to allocate ICMP error queue");
+        return ERROR_OUT_OF_MEMORY;
+    }
+    spinlock_init(&g_icmp.queue_lock);
+    g_icmp.hash_seed = (uint32_t)icmp_now_ns() ^ (uint32_t)(uintptr_t)&g_icmp;
+
+    /* Everything the replies have in common is filled in once */
+    g_icmp.template_v4.version_ihl = (IP_VERSION_4 << 4) | (IPV4_HEADER_MIN_LEN / 4);
+    g_icmp.template_v4.ttl = ICMP_DEFAULT_TTL;
+    g_icmp.template_v4.protocol = IP_PROTO_ICMP;
+    g_icmp.template_v6.version_tc_fl = htonl((uint32_t)IP_VERSION_6 << 28);
+    g_icmp.template_v6.next_header = IP_PROTO_ICMPV6;
+    g_icmp.template_v6.hop_limit = ICMP_DEFAULT_TTL;
+
+    /* The addresses is_local_address() answers to until interfaces carry their own */
+    memcpy(&src_v4, default_v4, sizeof(src_v4));
+    memcpy(&src_v6, default_v6, sizeof(src_v6));
+    icmp_set_source_address(&src_v4, &src_v6);
+
+    g_icmp.initialized = true;
+    icmp_set_rate_limit(ICMP_RATE_DEFAULT, ICMP_BURST_DEFAULT);
+
+    LOG_INFO(LOG_CATEGORY_L3, "ICMP error engine initialized");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Release the ICMP error engine; queued errors are dropped
+ *
+ * @return STATUS_SUCCESS on success
+ */
+status_t icmp_shutdown(void) {
+    if (!g_icmp.initialized) {
+        return STATUS_SUCCESS;
+    }
+
+    g_icmp.initialized = false;
+    packet_ring_destroy(g_icmp.queue);
+    g_icmp.queue = NULL;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Set the per-source rate limit
+ *
+ * @param rate Errors per second to one source, 0 disables error messages
+ * @param burst Errors a quiet source may get back to back (1..65535)
+ * @return STATUS_SUCCESS on success, ERROR_INVALID_PARAMETER on a bad burst
+ */
+status_t icmp_set_rate_limit(uint32_t rate, uint32_t burst) {
+    if (!g_icmp.initialized) {
+        return ERROR_NOT_INITIALIZED;
+    }
+    if (burst == 0 || burst > UINT16_MAX) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    uint64_t interval = rate ? ICMP_NS_PER_SEC / rate : 0;
+    __atomic_store_n(&g_icmp.interval_ns, interval, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_icmp.depth_ns, (uint64_t)burst * interval, __ATOMIC_RELAXED);
+    memset(g_icmp.buckets, 0, sizeof(g_icmp.buckets));
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Set the source addresses of error messages
+ *
+ * @param ipv4 Source of ICMP messages (network order), NULL to keep it
+ * @param ipv6 Source of ICMPv6 messages, NULL to keep it
+ * @return STATUS_SUCCESS on success
+ */
+status_t icmp_set_source_address(const ipv4_addr_t *ipv4, const ipv6_addr_t *ipv6) {
+    if (ipv4) {
+        g_icmp.template_v4.src_addr = *ipv4;
+    }
+    if (ipv6) {
+        memcpy(&g_icmp.template_v6.src_addr, ipv6, sizeof(ipv6_addr_t));
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Report a dropped datagram to its source
+ *
+ * Runs on the forwarding worker: after the checks only the quote is
+ * copied, and the message is finished on the control plane.
+ *
+ * @param packet Dropped packet
+ * @param l3_offset Offset of its IP header
+ * @param type ICMP or ICMPv6 type, matching the IP version of the packet
+ * @param code Message code
+ * @param param Next-hop MTU for Fragmentation Needed and Packet Too Big, 0 otherwise
+ * @return STATUS_SUCCESS if the error was queued, appropriate error code otherwise
+ */
+status_t icmp_send_error(const packet_buffer_t *packet, uint16_t l3_offset,
+                         uint8_t type, uint8_t code, uint32_t param) {
+    const void *template;
+    uint16_t header_len;
+    uint32_t quote_len;
+    uint32_t hash;
+    uint8_t version;
+
+    if (!packet) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    if (!g_icmp.initialized) {
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    ICMP_STAT_INC(errors_requested);
+
+    uint32_t length = packet_chain_length(packet);
+    if (l3_offset >= length || packet_peek_byte(packet, l3_offset, &version) != STATUS_SUCCESS) {
+        ICMP_STAT_INC(errors_suppressed);
+        return ERROR_INVALID_PACKET;
+    }
+    length -= l3_offset;
+    version >>= 4;
+
+    if (version == IP_VERSION_4) {
+        const ipv4_header_t *header = packet_peek_ptr(packet, l3_offset, sizeof(*header));
+        if (!header || !icmp_ipv4_may_answer(packet, l3_offset, header)) {
+            ICMP_STAT_INC(errors_suppressed);
+            return ERROR_INVALID_PACKET;
+        }
+        uint32_t total_length = ntohs(header->total_length);
+        quote_len = total_length < length ? total_length : length;
+        if (quote_len > ICMP_V4_QUOTE_MAX) {
+            quote_len = ICMP_V4_QUOTE_MAX;
+        }
+        hash = icmp_hash_source(&header->src_addr, sizeof(header->src_addr));
+        template = &g_icmp.template_v4;
+        header_len = sizeof(ipv4_header_t);
+    } else if (version == IP_VERSION_6) {
+        const ipv6_header_t *header = packet_peek_ptr(packet, l3_offset, sizeof(*header));
+        if (!header || !icmp_ipv6_may_answer(packet, l3_offset, header, type)) {
+            ICMP_STAT_INC(errors_suppressed);
+            return ERROR_INVALID_PACKET;
+        }
+        uint32_t total_length = (uint32_t)ntohs(header->payload_length) + IPV6_HEADER_LEN;
+        quote_len = total_length < length ? total_length : length;
+        if (quote_len > ICMP_V6_QUOTE_MAX) {
+            quote_len = ICMP_V6_QUOTE_MAX;
+        }
+        /* Hosts of one /64 share a bucket, however many addresses they use */
+        hash = icmp_hash_source(&header->src_addr, 8);
+        template = &g_icmp.template_v6;
+        header_len = sizeof(ipv6_header_t);
+    } else {
+        ICMP_STAT_INC(errors_suppressed);
+        return ERROR_UNSUPPORTED_PROTOCOL;
+    }
+
+    if (!icmp_bucket_take(&g_icmp.buckets[hash & (ICMP_BUCKET_COUNT - 1)], icmp_now_ns())) {
+        ICMP_STAT_INC(errors_rate_limited);
+        return ERROR_ICMP_RATE_LIMITED;
+    }
+
+    /* Reply header from the template, the ICMP header, then the quote */
+    uint32_t size = header_len + ICMP_HEADER_LEN + quote_len;
+    packet_buffer_t *msg = packet_buffer_alloc(size);
+    if (!msg) {
+        ICMP_STAT_INC(errors_queue_full);
+        return ERROR_PACKET_ALLOCATION_FAILED;
+    }
+
+    icmp_header_t icmp = { .type = type, .code = code, .checksum = 0, .param = htonl(param) };
+    memcpy(msg->data, template, header_len);
+    memcpy(msg->data + header_len, &icmp, sizeof(icmp));
+    if (packet_peek_data(packet, l3_offset, msg->data + header_len + ICMP_HEADER_LEN, quote_len) != STATUS_SUCCESS) {
+        packet_buffer_free(msg);
+        ICMP_STAT_INC(errors_suppressed);
+        return ERROR_PACKET_OPERATION_FAILED;
+    }
+    msg->size = size;
+    msg->metadata.port = port_cpu_id();
+
+    /* Workers share the queue; only the control plane consumes it */
+    spinlock_acquire(&g_icmp.queue_lock);
+    uint32_t queued = packet_ring_enqueue_burst(g_icmp.queue, &msg, 1);
+    spinlock_release(&g_icmp.queue_lock);
+
+    if (queued == 0) {
+        packet_buffer_free(msg);
+        ICMP_STAT_INC(errors_queue_full);
+        return STATUS_RESOURCE_EXCEEDED;
+    }
+
+    ICMP_STAT_INC(errors_queued);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Finish and send queued error messages (control-plane thread only)
+ *
+ * @param budget Maximum number of messages to send
+ * @return Number of messages taken from the queue
+ */
+uint32_t icmp_process_errors(uint32_t budget) {
+    packet_buffer_t *msgs[PACKET_BURST_MAX];
+    uint32_t done = 0;
+
+    if (!g_icmp.initialized) {
+        return 0;
+    }
+
+    while (done < budget) {
+        uint32_t want = budget - done < PACKET_BURST_MAX ? budget - done : PACKET_BURST_MAX;
+        uint32_t n = packet_ring_dequeue_burst(g_icmp.queue, msgs, want);
+        if (n == 0) {
+            break;
+        }
+
+        for (uint32_t i = 0; i < n; i++) {
+            status_t status = icmp_finish(msgs[i]);
+            if (status == STATUS_SUCCESS) {
+                /* A message held for neighbor resolution leaves with the reply */
+                status = ip_output_packet(msgs[i]);
+            }
+            if (status == STATUS_SUCCESS || status == ERROR_PENDING_RESOLUTION) {
+                ICMP_STAT_INC(errors_sent);
+            } else {
+                LOG_DEBUG(LOG_CATEGORY_L3, "ICMP error message not sent: error=%d", status);
+                ICMP_STAT_INC(errors_send_failed);
+            }
+            packet_buffer_free(msgs[i]);
+        }
+        done += n;
+    }
+
+    return done;
+}
+
+/**
+ * @brief Get ICMP error statistics
+ *
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, ERROR_INVALID_PARAMETER if stats is NULL
+ */
+status_t icmp_get_stats(icmp_stats_t *stats) {
+    if (!stats) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    stats->errors_requested = __atomic_load_n(&g_icmp.stats.errors_requested, __ATOMIC_RELAXED);
+    stats->errors_suppressed = __atomic_load_n(&g_icmp.stats.errors_suppressed, __ATOMIC_RELAXED);
+    stats->errors_rate_limited = __atomic_load_n(&g_icmp.stats.errors_rate_limited, __ATOMIC_RELAXED);
+    stats->errors_queue_full = __atomic_load_n(&g_icmp.stats.errors_queue_full, __ATOMIC_RELAXED);
+    stats->errors_queued = __atomic_load_n(&g_icmp.stats.errors_queued, __ATOMIC_RELAXED);
+    stats->errors_sent = __atomic_load_n(&g_icmp.stats.errors_sent, __ATOMIC_RELAXED);
+    stats->errors_send_failed = __atomic_load_n(&g_icmp.stats.errors_send_failed, __ATOMIC_RELAXED);
+    return STATUS_SUCCESS;
+}
+
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/**
+ * @brief Current monotonic time in nanoseconds
+ */
+static uint64_t icmp_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * ICMP_NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Hash a source address onto the rate-limit buckets
+ *
+ * @param key Address bytes
+ * @param len Number of bytes
+ * @return Seeded hash
+ */
+static uint32_t icmp_hash_source(const void *key, size_t len) {
+    const uint8_t *bytes = (const uint8_t *)key;
+    uint32_t hash = g_icmp.hash_seed;
+
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ bytes[i]) * 0x01000193U;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+/**
+ * @brief Take one error from a bucket
+ *
+ * @param bucket Theoretical arrival time of the bucket
+ * @param now Current time (ns)
+ * @return true if the error conforms
+ */
+static bool icmp_bucket_take(uint64_t *bucket, uint64_t now) {
+    uint64_t interval = __atomic_load_n(&g_icmp.interval_ns, __ATOMIC_RELAXED);
+    uint64_t depth = __atomic_load_n(&g_icmp.depth_ns, __ATOMIC_RELAXED);
+    uint64_t tat = __atomic_load_n(bucket, __ATOMIC_RELAXED);
+
+    if (interval == 0) {
+        return false;
+    }
+
+    for (;;) {
+        uint64_t next = (tat > now ? tat : now) + interval;
+        if (next - now > depth) {
+            return false;
+        }
+        if (__atomic_compare_exchange_n(bucket, &tat, next, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return true;
+        }
+    }
+}
+
+/**
+ * @brief Check whether an IPv4 datagram may be answered with an error
+ *
+ * No error goes back for an ICMP error, a fragment other than the first,
+ * a datagram sent to a multicast or broadcast address, or a source that
+ * does not name a single host (RFC 1812 4.3.2.7).
+ *
+ * @param packet Dropped packet
+ * @param l3_offset Offset of its IP header
+ * @param header Copy of its IP header
+ * @return true if an error may be sent
+ */
+static bool icmp_ipv4_may_answer(const packet_buffer_t *packet, uint16_t l3_offset,
+                                 const ipv4_header_t *header) {
+    const uint8_t *src = (const uint8_t *)&header->src_addr;
+    const uint8_t *dst = (const uint8_t *)&header->dst_addr;
+
+    if (ntohs(header->flags_fragment_offset) & ICMP_FRAG_OFFSET_MASK) {
+        return false;
+    }
+    if (src[0] == 0 || src[0] == 127 || src[0] >= 224 || dst[0] >= 224) {
+        return false;
+    }
+    if (packet_has_proto(packet, PACKET_PROTO_L2_BCAST | PACKET_PROTO_L2_MCAST)) {
+        return false;
+    }
+
+    if (header->protocol == IP_PROTO_ICMP) {
+        uint8_t type;
+        uint16_t header_len = (header->version_ihl & 0x0F) * 4;
+        if (packet_peek_byte(packet, l3_offset + header_len, &type) != STATUS_SUCCESS) {
+            return false;
+        }
+        /* Destination Unreachable, Source Quench, Redirect, Time Exceeded, Parameter Problem */
+        if (type == 3 || type == 4 || type == 5 || type == 11 || type == 12) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Check whether an IPv6 datagram may be answered with an error
+ *
+ * No error goes back for an ICMPv6 error or to an unspecified or multicast
+ * source. Datagrams sent to a multicast group only get Packet Too Big, so
+ * path MTU discovery keeps working for them (RFC 4443 2.4(e)).
+ *
+ * @param packet Dropped packet
+ * @param l3_offset Offset of its IP header
+ * @param header Copy of its IP header
+ * @param type ICMPv6 type of the error
+ * @return true if an error may be sent
+ */
+static bool icmp_ipv6_may_answer(const packet_buffer_t *packet, uint16_t l3_offset,
+                                 const ipv6_header_t *header, uint8_t type) {
+    static const ipv6_addr_t unspecified;
+
+    if (header->src_addr.addr[0] == 0xFF ||
+        memcmp(&header->src_addr, &unspecified, sizeof(ipv6_addr_t)) == 0) {
+        return false;
+    }
+    if (type != ICMPV6_TYPE_PACKET_TOO_BIG &&
+        (header->dst_addr.addr[0] == 0xFF ||
+         packet_has_proto(packet, PACKET_PROTO_L2_BCAST | PACKET_PROTO_L2_MCAST))) {
+        return false;
+    }
+
+    if (header->next_header == IP_PROTO_ICMPV6) {
+        uint8_t icmp_type;
+        if (packet_peek_byte(packet, l3_offset + IPV6_HEADER_LEN, &icmp_type) != STATUS_SUCCESS ||
+            icmp_type <= ICMPV6_ERROR_TYPE_MAX) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Add bytes to a ones' complement sum
+ *
+ * @param sum Running sum
+ * @param data Bytes to add, read as big-endian 16-bit words
+ * @param len Number of bytes
+ * @return New running sum
+ */
+static uint32_t icmp_sum(uint32_t sum, const uint8_t *data, size_t len) {
+    while (len > 1) {
+        sum += ((uint32_t)data[0] << 8) | data[1];
+        data += 2;
+        len -= 2;
+    }
+    if (len) {
+        sum += (uint32_t)data[0] << 8;
+    }
+    return sum;
+}
+
+/**
+ * @brief Fold a ones' complement sum into a checksum field
+ *
+ * @param sum Running sum
+ * @return Checksum in network order
+ */
+static uint16_t icmp_fold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return htons((uint16_t)~sum);
+}
+
+/**
+ * @brief Complete a queued message: destination, lengths and checksums
+ *
+ * The destination is the source of the quoted datagram.
+ *
+ * @param msg Message built by icmp_send_error()
+ * @return STATUS_SUCCESS on success, ERROR_INVALID_PACKET if malformed
+ */
+static status_t icmp_finish(packet_buffer_t *msg) {
+    uint8_t *data = msg->data;
+
+    if ((data[0] >> 4) == IP_VERSION_4) {
+        ipv4_header_t *ip = (ipv4_header_t *)data;
+        const uint8_t *quote = data + sizeof(ipv4_header_t) + ICMP_HEADER_LEN;
+        uint8_t *icmp = data + sizeof(ipv4_header_t);
+
+        memcpy(&ip->dst_addr, quote + offsetof(ipv4_header_t, src_addr), sizeof(ipv4_addr_t));
+        ip->total_length = htons((uint16_t)msg->size);
+        ip->identification = htons(g_icmp.ident++);
+        ip->header_checksum = 0;
+        ip->header_checksum = icmp_fold(icmp_sum(0, data, sizeof(ipv4_header_t)));
+
+        uint16_t checksum = icmp_fold(icmp_sum(0, icmp, msg->size - sizeof(ipv4_header_t)));
+        memcpy(icmp + offsetof(icmp_header_t, checksum), &checksum, sizeof(checksum));
+        return STATUS_SUCCESS;
+    }
+
+    if ((data[0] >> 4) == IP_VERSION_6) {
+        ipv6_header_t *ip = (ipv6_header_t *)data;
+        const uint8_t *quote = data + sizeof(ipv6_header_t) + ICMP_HEADER_LEN;
+        uint8_t *icmp = data + sizeof(ipv6_header_t);
+        uint32_t icmp_len = msg->size - sizeof(ipv6_header_t);
+
+        memcpy(&ip->dst_addr, quote + offsetof(ipv6_header_t, src_addr), sizeof(ipv6_addr_t));
+        ip->payload_length = htons((uint16_t)icmp_len);
+
+        /* Pseudo-header: addresses, upper-layer length and next header */
+        uint32_t sum = icmp_sum(0, (const uint8_t *)&ip->src_addr, 2 * sizeof(ipv6_addr_t));
+        sum += icmp_len >> 16;
+        sum += icmp_len & 0xFFFF;
+        sum += IP_PROTO_ICMPV6;
+        uint16_t checksum = icmp_fold(icmp_sum(sum, icmp, icmp_len));
+        memcpy(icmp + offsetof(icmp_header_t, checksum), &checksum, sizeof(checksum));
+        return STATUS_SUCCESS;
+    }
+
+    return ERROR_INVALID_PACKET;
+}
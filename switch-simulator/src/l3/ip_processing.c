@@ -19,19 +19,34 @@
 #include <stdbool.h>
 #include <sys/time.h>   /* For gettimeofday */
 #include <arpa/inet.h>  /* For network byte order conversions */
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
+#include "common/config.h"
 #include "common/error_codes.h"
 #include "common/logging.h"
+#include "common/mem_account.h"
+#include "common/rcu.h"
+#include "common/threading.h"
 #include "common/types.h"
 #include "common/utils.h"
 
 #include "hal/packet.h"
 #include "hal/port.h"
+#include "hal/hw_simulation.h"
+#include "hal/packet_offload.h"
+#include "hal/packet_drop.h"
+#include "l2/mac_table.h"
 #include "l2/vlan.h"
 #include "l3/ip.h"
 #include "l3/ip_processing.h"
 #include "l3/routing_table.h"
 #include "l3/arp.h"
+#include "l3/icmp.h"
+#include "l3/punt.h"
+#include "l3/mcast_fib.h"
+#include "l3/acl.h"
 #include "management/stats.h"
 
 #if defined(__GNUC__) || defined(__clang__)
@@ -54,10 +69,24 @@ extern routing_table_t *routing_table_get_instance(void);
 #define IP_FLAG_MF               0x2000  /* More Fragments flag */
 #define IP_FRAG_OFFSET_MASK      0x1FFF  /* Fragment offset mask */
 #define IP_FRAGMENT_UNIT         8       /* Fragment offset unit size in bytes */
+#define IP_FRAG_HEADERS_MAX      256     /* Unfragmentable bytes kept from a first fragment */
+#define IPV6_FRAG_HEADER_LEN     8       /* IPv6 Fragment extension header length */
+#define IPV6_FRAG_OFFSET_MASK    0xFFF8  /* IPv6 fragment offset, already in bytes */
+#define IPV6_FRAG_FLAG_M         0x0001  /* IPv6 More Fragments flag */
+#define IP_FRAG_HASH_SIZE        1024    /* Reassembly buckets per family, a power of two */
+#define IP_FRAG_WHEEL_SLOTS      64      /* One-second expiry slots, a power of two */
+#define IP_FRAG_SOURCE_BUCKETS   256     /* Per-source memory accounts, a power of two */
+#define IP_FRAG_SOURCE_MAX_BYTES (256 * 1024) /* Reassembly memory one source may hold */
+#define IP_FLOW_CACHE_BITS       10      /* Flows in each worker's cache, as a power of two */
+#define IP_FLOW_CACHE_SIZE       (1U << IP_FLOW_CACHE_BITS)
+#define IP_FLOW_CACHE_MAX_WORKERS (CONFIG_MAX_WORKER_THREADS + 4)
+#define IP_FLOW_CACHE_ALIGN      64
+#define IP_VALIDATE_BURST_MAX    64      /* Headers one validate_ipv4_headers_burst() call covers */
 #define TTL_DEFAULT              64      /* Default TTL value for originated packets */
 #define TTL_THRESHOLD            1       /* Minimum TTL value to forward packet */
 #define IPV6_HOP_LIMIT_DEFAULT   64      /* Default hop limit for IPv6 */
 #define IPV6_HOP_LIMIT_THRESHOLD 1       /* Minimum hop limit to forward IPv6 packet */
+#define IPV6_HOP_LIMIT_ND        255     /* Hop limit of every Neighbor Discovery message */
 
 /* IP Protocol Numbers (common ones) */
 #define IP_PROTO_ICMP            1
@@ -89,46 +118,110 @@ typedef struct {
     uint64_t forwarded_packets;
     uint64_t local_delivered;
     uint64_t dropped_packets;
+    uint64_t flow_cache_hits;
+    uint64_t flow_cache_misses;
 } ip_stats_t;
 
 /* Global statistics structure */
 static ip_stats_t g_ip_stats;
 
+/**
+ * @brief Count a dropped packet in the IP statistics and under its drop reason
+ *
+ * @param packet Dropped packet, NULL if it is already gone
+ * @param reason Drop reason
+ */
+static inline void ip_count_drop(packet_buffer_t *packet, packet_drop_reason_t reason) {
+    g_ip_stats.dropped_packets++;
+    packet_drop_count(packet, reason);
+}
+
 /* Maximum Transmission Unit table */
 static uint16_t g_port_mtu_table[MAX_PORTS];
 
+/*
+ * Fragments of one datagram waiting for reassembly. Each fragment payload
+ * is held as a zero-copy slice of the received packet, sorted by offset;
+ * reassembly links the slices behind a segment carrying the headers of the
+ * first fragment.
+ */
+typedef struct {
+    uint32_t total_length;      /* Payload length, 0 until the last fragment arrives */
+    uint32_t received_length;   /* Payload bytes held in fragments[] */
+    uint16_t l3_offset;         /* IP header offset within headers[] */
+    uint16_t headers_len;       /* Bytes in headers[], 0 until the first fragment arrives */
+    uint8_t headers[IP_FRAG_HEADERS_MAX];
+    packet_metadata_t metadata; /* Metadata of the first fragment */
+    uint16_t fragment_count;
+    uint16_t frag_offsets[MAX_FRAGMENTS];
+    uint16_t frag_lengths[MAX_FRAGMENTS];
+    packet_buffer_t *fragments[MAX_FRAGMENTS];
+} ip_frag_queue_t;
+
+/*
+ * Expiry and memory accounting of a reassembly entry, first member of the
+ * entries of both families. Entries sit in the expiry wheel slot of their
+ * deadline; a slot also holds entries due a multiple of
+ * IP_FRAG_WHEEL_SLOTS seconds later, which are skipped until then.
+ */
+typedef struct ip_frag_timer {
+    struct ip_frag_timer *next;     /* Next entry of the same wheel slot */
+    struct ip_frag_timer **pprev;   /* Link pointing at this entry */
+    uint32_t deadline;              /* Expiry time in seconds */
+    uint32_t charged;               /* Bytes charged to the source account */
+    uint16_t source;                /* Source account */
+    bool is_ipv6;
+} ip_frag_timer_t;
+
 /* IPv4 Fragment reassembly context */
 typedef struct ipv4_frag_entry {
+    ip_frag_timer_t timer;
     ipv4_addr_t src_addr;
     ipv4_addr_t dst_addr;
     uint16_t ident;
     uint8_t protocol;
-    uint32_t arrival_time;
-    uint32_t total_length;
-    uint16_t fragment_flags;
-    uint8_t *reassembled_data;
-    uint16_t fragments_received;
-    bool fragments[MAX_FRAGMENTS];
-    struct ipv4_frag_entry *next;
+    ip_frag_queue_t queue;
+    struct ipv4_frag_entry *next; /* Next entry of the same hash bucket */
 } ipv4_frag_entry_t;
 
 /* IPv6 Fragment reassembly context */
 typedef struct ipv6_frag_entry {
+    ip_frag_timer_t timer;
     ipv6_addr_t src_addr;
     ipv6_addr_t dst_addr;
     uint32_t ident;
-    uint8_t next_header;
-    uint32_t arrival_time;
-    uint32_t total_length;
-    uint8_t *reassembled_data;
-    uint16_t fragments_received;
-    bool fragments[MAX_FRAGMENTS];
-    struct ipv6_frag_entry *next;
+    uint8_t next_header;        /* Next Header of the Fragment header */
+    uint16_t prev_nh_offset;    /* Offset of the Next Header field pointing at it */
+    ip_frag_queue_t queue;
+    struct ipv6_frag_entry *next; /* Next entry of the same hash bucket */
 } ipv6_frag_entry_t;
 
-/* Fragment reassembly tables */
-static ipv4_frag_entry_t *g_ipv4_frag_table = NULL;
-static ipv6_frag_entry_t *g_ipv6_frag_table = NULL;
+/* Fragment reassembly tables, hashed by (src, dst, id, proto) */
+static ipv4_frag_entry_t *g_ipv4_frag_table[IP_FRAG_HASH_SIZE];
+static ipv6_frag_entry_t *g_ipv6_frag_table[IP_FRAG_HASH_SIZE];
+static uint32_t g_frag_hash_seed;
+
+/* Reassembly expiry wheel and per-source memory accounts */
+static ip_frag_timer_t *g_frag_wheel[IP_FRAG_WHEEL_SLOTS];
+static uint32_t g_frag_wheel_time;          /* Last second the wheel was advanced to */
+static uint32_t g_frag_source_bytes[IP_FRAG_SOURCE_BUCKETS];
+
+/*
+ * Fragments of one datagram on their way out. With a resolved next hop
+ * every fragment gets the L2 rewrite in its header segment and leaves in
+ * TX bursts; otherwise the fragments are held on the neighbor like any
+ * other packet waiting for resolution.
+ */
+typedef struct {
+    const arp_rewrite_t *rewrite;   /* L2 header of the next hop, NULL if unresolved */
+    port_id_t egress_port;
+    uint8_t version;
+    ipv4_addr_t next_hop;           /* Next hop of an IPv4 datagram */
+    ipv6_addr_t next_hop6;          /* Next hop of an IPv6 datagram */
+    uint32_t count;                 /* Fragments in pkts[] */
+    uint32_t sent;                  /* Fragments sent or held so far */
+    packet_buffer_t *pkts[PACKET_BURST_MAX];
+} ip_frag_tx_t;
 
 /* IPv6 extension header processing context */
 typedef struct {
@@ -136,11 +229,78 @@ typedef struct {
     uint16_t current_offset;
     uint8_t next_header;
     bool has_fragment_header;
+    uint16_t frag_hdr_offset;       /* Offset of the Fragment header */
+    uint16_t frag_prev_nh_offset;   /* Offset of the Next Header field naming it */
+    uint16_t frag_offset_flags;     /* Fragment offset and M flag, host order */
+    uint32_t frag_ident;            /* Fragment identification, host order */
     bool has_routing_header;
     uint8_t routing_type;
     uint8_t segments_left;
 } ipv6_ext_headers_ctx_t;
 
+/*
+ * Exact-match key of a routed flow. IPv4 addresses use the first four
+ * bytes of src and dst; the rest of the key is zeroed so it compares and
+ * hashes as plain words.
+ */
+typedef struct {
+    uint8_t src[sizeof(ipv6_addr_t)];
+    uint8_t dst[sizeof(ipv6_addr_t)];
+    uint16_t src_port;              /* TCP or UDP ports, 0 for other protocols */
+    uint16_t dst_port;
+    uint16_t in_port;               /* Ingress port */
+    uint16_t vlan;                  /* Ingress VLAN */
+    uint8_t protocol;               /* IPv4 protocol or IPv6 next header */
+    uint8_t version;
+    uint16_t pad;
+} ip_flow_key_t;
+
+/*
+ * Forwarding decision of an established flow: what the slow path did to
+ * its last packet. It holds while the FIB, neighbor and MAC generations it
+ * was made at are current; fib_generation is 0 while the slot is empty.
+ */
+typedef struct {
+    ip_flow_key_t key;
+    arp_rewrite_t rewrite;          /* Copy of the next hop's L2 header */
+    port_id_t egress_port;
+    uint8_t qos_class;              /* Priority the packet left with */
+    uint32_t fib_generation;
+    uint32_t arp_generation;
+    uint32_t mac_generation;
+    uint32_t pbr_generation;
+} ip_flow_entry_t;
+
+/* Direct-mapped flow cache of one worker thread, written only by it */
+typedef struct {
+    ip_flow_entry_t slots[IP_FLOW_CACHE_SIZE];
+} ip_flow_cache_t;
+
+/* Flow whose packet is on the slow path, installed once it is forwarded */
+typedef struct {
+    const packet_buffer_t *packet;  /* Packet being routed, NULL if none */
+    ip_flow_entry_t *slot;          /* Slot it goes into */
+    ip_flow_entry_t entry;          /* Key and generations taken before routing */
+} ip_flow_pending_t;
+
+/* Flow caches, one per forwarding worker */
+static bool g_flow_cache_enabled;
+static spinlock_t g_flow_cache_lock;        /* Serializes registration of worker caches */
+static ip_flow_cache_t *g_flow_caches[IP_FLOW_CACHE_MAX_WORKERS];
+static uint32_t g_flow_cache_count;
+static uint32_t g_flow_cache_epoch;         /* Bumped on shutdown to orphan thread caches */
+static __thread ip_flow_cache_t *t_flow_cache;
+static __thread uint32_t t_flow_cache_epoch;
+static __thread ip_flow_pending_t t_flow_pending;
+
+/* IPv4 header check stage of the packet pipeline */
+#if defined(__SSE2__) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define IP_VALIDATE_AVX2 1
+static bool g_ipv4_validate_avx2;           /* CPU has AVX2, probed at init */
+#endif
+static uint32_t g_ip_validate_handle = UINT32_MAX;
+static uint32_t g_ip_route_handle = UINT32_MAX;
+
 /* Forward declarations */
 
 /* Временный прототип для stats_register_counter */
@@ -149,29 +309,66 @@ status_t stats_register_counter(const char *counter_name, uint64_t *counter_ptr)
 
 /* --- UTILITY FUNCTIONS -----------------------------------------------------*/
 static uint16_t calculate_ipv4_checksum(const void *data, size_t len);
+static inline void ipv4_decrement_ttl(ipv4_header_t *header);
+static inline void ipv4_forward_ttl(packet_buffer_t *packet, ipv4_header_t *header, uint32_t egress_offloads);
 static bool is_local_address(const void *addr, bool is_ipv6);
 static void cleanup_stale_fragments(void);
+static uint16_t ip_available_length(const packet_buffer_t *packet, uint16_t offset);
 
 /* --- VALIDATION FUNCTIONS --------------------------------------------------*/
-static status_t validate_ipv4_header(const ipv4_header_t *header, uint16_t packet_len);
+static status_t validate_ipv4_header(const ipv4_header_t *header, uint16_t packet_len, bool verify_checksum);
 static status_t validate_ipv6_header(const ipv6_header_t *header, uint16_t packet_len);
+static void ip_validate_burst_stage(packet_buffer_t **pkts, uint32_t count, packet_result_t *results, void *user_data);
+static void ip_route_burst_stage(packet_buffer_t **pkts, uint32_t count, packet_result_t *results, void *user_data);
 
 /* --- HEADER PROCESSING -----------------------------------------------------*/
 static status_t process_ipv4_options(const ipv4_header_t *header, packet_buffer_t *packet);
 static status_t process_ipv6_extension_headers(packet_buffer_t *packet, uint16_t *offset, ipv6_ext_headers_ctx_t *ctx);
 
 /* --- FRAGMENTATION ---------------------------------------------------------*/
+static uint32_t frag_mix(uint32_t hash);
+static uint32_t frag_hash_ipv4(ipv4_addr_t src, ipv4_addr_t dst, uint16_t ident, uint8_t protocol);
+static uint32_t frag_hash_ipv6(const ipv6_addr_t *src, const ipv6_addr_t *dst, uint32_t ident);
+static uint32_t frag_now_sec(void);
+static void frag_timer_start(ip_frag_timer_t *timer, bool is_ipv6, uint32_t source_hash);
+static void frag_timer_stop(ip_frag_timer_t *timer);
+static bool frag_source_charge(ip_frag_timer_t *timer, uint32_t bytes);
 static ipv4_frag_entry_t *find_ipv4_frag_entry(const ipv4_header_t *header);
 static ipv6_frag_entry_t *find_ipv6_frag_entry(const ipv6_addr_t *src, const ipv6_addr_t *dst, uint32_t ident);
+static ipv4_frag_entry_t *create_ipv4_frag_entry(const ipv4_header_t *header);
+static ipv6_frag_entry_t *create_ipv6_frag_entry(const ipv6_header_t *header, uint32_t ident);
+static status_t frag_queue_insert(ip_frag_queue_t *queue, const packet_buffer_t *packet,
+                                  uint16_t l3_offset, uint16_t headers_len, uint16_t payload_offset,
+                                  uint32_t frag_offset, uint32_t data_len, bool last);
+static packet_buffer_t *frag_queue_build(ip_frag_queue_t *queue);
+static void frag_queue_release(ip_frag_queue_t *queue);
+static void remove_ipv4_frag_entry(ipv4_frag_entry_t *entry);
+static void remove_ipv6_frag_entry(ipv6_frag_entry_t *entry);
 static status_t reassemble_ipv4_fragments(ipv4_frag_entry_t *entry, packet_t **reassembled);
 static status_t reassemble_ipv6_fragments(ipv6_frag_entry_t *entry, packet_t **reassembled);
-static status_t fragment_ipv4_packet(packet_buffer_t *packet, uint16_t mtu, port_id_t egress_port);
-static status_t fragment_ipv6_packet(packet_buffer_t *packet, uint16_t mtu, port_id_t egress_port);
+static status_t frag_tx_add(ip_frag_tx_t *tx, const packet_buffer_t *packet, const void *headers,
+                            uint16_t headers_len, const void *ext, uint16_t ext_len,
+                            uint32_t payload_offset, uint32_t payload_len);
+static void frag_tx_flush(ip_frag_tx_t *tx);
+static void frag_tx_discard(ip_frag_tx_t *tx);
+static status_t fragment_ipv4_packet(packet_buffer_t *packet, uint16_t mtu, ip_frag_tx_t *tx);
+static status_t fragment_ipv6_packet(packet_buffer_t *packet, uint16_t mtu, ip_frag_tx_t *tx);
+static status_t forward_fragments(packet_buffer_t *packet, uint16_t mtu, ip_frag_tx_t *tx);
+
+/* --- FLOW CACHE ------------------------------------------------------------*/
+static ip_flow_cache_t *flow_cache_get(void);
+static bool flow_key_build(const packet_buffer_t *packet, uint16_t offset, uint8_t version, ip_flow_key_t *key);
+static bool flow_cache_forward(packet_buffer_t *packet, uint16_t offset, uint8_t version, status_t *status);
+static void flow_cache_install(const packet_buffer_t *packet, port_id_t egress_port, const arp_rewrite_t *rewrite);
+static void flow_cache_free_all(void);
 
 /* --- PACKET PROCESSING -----------------------------------------------------*/
 static status_t process_ipv4_packet(packet_buffer_t *packet, uint16_t *offset);
 static status_t process_ipv6_packet(packet_buffer_t *packet, uint16_t *offset);
+static status_t process_ipv6_fragment(packet_buffer_t *packet, uint16_t l3_offset, const ipv6_ext_headers_ctx_t *ctx);
 static status_t forward_ip_packet(packet_buffer_t *packet, const route_entry_t *route);
+static bool policy_route(const packet_buffer_t *packet, uint16_t l3_offset, bool is_ipv6, route_entry_t *route);
+static status_t forward_ipv4_multicast(packet_buffer_t *packet, uint16_t offset);
 static status_t deliver_to_local_stack(packet_buffer_t *packet, uint8_t protocol);
 
 
@@ -209,11 +406,53 @@ status_t ip_processing_init(void) {
     
     /* Initialize statistics */
     memset(&g_ip_stats, 0, sizeof(g_ip_stats));
+
+    /* Reassembly buckets are keyed with a per-boot seed so floods cannot aim at one chain */
+    g_frag_hash_seed = frag_mix((uint32_t)get_system_time_ms() ^ (uint32_t)(uintptr_t)&g_frag_hash_seed);
+    g_frag_wheel_time = frag_now_sec();
+    spinlock_init(&g_flow_cache_lock);
+#ifdef IP_VALIDATE_AVX2
+    __builtin_cpu_init();
+    g_ipv4_validate_avx2 = __builtin_cpu_supports("avx2");
+#endif
     
     /* Initialize default MTU for all ports */
     for (int i = 0; i < MAX_PORTS; i++) {
         g_port_mtu_table[i] = DEFAULT_MTU;
     }
+
+    /* Dropped datagrams are reported to their sources from the control plane */
+    status_t status = icmp_init();
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR( LOG_CATEGORY_L3, "Failed to initialize ICMP error generation: error=%d", status);
+        return status;
+    }
+
+    /* Traffic for the switch itself is handled off the forwarding workers */
+    status = punt_init();
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR( LOG_CATEGORY_L3, "Failed to initialize the punt path: error=%d", status);
+        icmp_shutdown();
+        return status;
+    }
+
+    /* Malformed IPv4 headers are dropped a burst at a time, before the ACL sees them */
+    if (packet_register_burst_processor(ip_validate_burst_stage, IP_VALIDATE_PROCESSOR_PRIORITY,
+                                        NULL, &g_ip_validate_handle) != STATUS_SUCCESS) {
+        LOG_WARNING( LOG_CATEGORY_L3, "Packet pipeline not available, IPv4 header check stage not registered");
+        g_ip_validate_handle = UINT32_MAX;
+    } else {
+        packet_set_processor_name(g_ip_validate_handle, "ip-validate");
+    }
+
+    /* Routed IPv4 bursts take the fused stage, after the ACL has seen them */
+    if (packet_register_burst_processor(ip_route_burst_stage, IP_ROUTE_PROCESSOR_PRIORITY,
+                                        NULL, &g_ip_route_handle) != STATUS_SUCCESS) {
+        LOG_WARNING( LOG_CATEGORY_L3, "Packet pipeline not available, IPv4 routing stage not registered");
+        g_ip_route_handle = UINT32_MAX;
+    } else {
+        packet_set_processor_name(g_ip_route_handle, "ip-route");
+    }
     
     /* Register statistics with the stats collector */
     stats_register_counter("ip.packets_processed", &g_ip_stats.packets_processed);
@@ -227,6 +466,8 @@ status_t ip_processing_init(void) {
     stats_register_counter("ip.forwarded_packets", &g_ip_stats.forwarded_packets);
     stats_register_counter("ip.local_delivered", &g_ip_stats.local_delivered);
     stats_register_counter("ip.dropped_packets", &g_ip_stats.dropped_packets);
+    stats_register_counter("ip.flow_cache_hits", &g_ip_stats.flow_cache_hits);
+    stats_register_counter("ip.flow_cache_misses", &g_ip_stats.flow_cache_misses);
     
     LOG_INFO( LOG_CATEGORY_L3, "IP Processing module initialized successfully");
     return STATUS_SUCCESS;
@@ -243,28 +484,26 @@ status_t ip_processing_shutdown(void) {
     LOG_INFO( LOG_CATEGORY_L3, "Shutting down IP Processing module");
     
     /* Free fragment reassembly tables */
-    ipv4_frag_entry_t *ipv4_entry = g_ipv4_frag_table;
-    while (ipv4_entry) {
-        ipv4_frag_entry_t *next = ipv4_entry->next;
-        if (ipv4_entry->reassembled_data) {
-            free(ipv4_entry->reassembled_data);
+    for (uint32_t i = 0; i < IP_FRAG_HASH_SIZE; i++) {
+        while (g_ipv4_frag_table[i]) {
+            remove_ipv4_frag_entry(g_ipv4_frag_table[i]);
         }
-        free(ipv4_entry);
-        ipv4_entry = next;
-    }
-    
-    ipv6_frag_entry_t *ipv6_entry = g_ipv6_frag_table;
-    while (ipv6_entry) {
-        ipv6_frag_entry_t *next = ipv6_entry->next;
-        if (ipv6_entry->reassembled_data) {
-            free(ipv6_entry->reassembled_data);
+        while (g_ipv6_frag_table[i]) {
+            remove_ipv6_frag_entry(g_ipv6_frag_table[i]);
         }
-        free(ipv6_entry);
-        ipv6_entry = next;
     }
-    
-    g_ipv4_frag_table = NULL;
-    g_ipv6_frag_table = NULL;
+
+    if (g_ip_route_handle != UINT32_MAX) {
+        packet_unregister_processor(g_ip_route_handle);
+        g_ip_route_handle = UINT32_MAX;
+    }
+    if (g_ip_validate_handle != UINT32_MAX) {
+        packet_unregister_processor(g_ip_validate_handle);
+        g_ip_validate_handle = UINT32_MAX;
+    }
+    punt_shutdown();
+    icmp_shutdown();
+    flow_cache_free_all();
     
     LOG_INFO( LOG_CATEGORY_L3, "IP Processing module shutdown complete");
     return STATUS_SUCCESS;
@@ -293,16 +532,25 @@ status_t ip_process_packet(packet_buffer_t *packet, uint16_t *offset) {
     if (*offset + sizeof(uint8_t) > packet->size) {
         LOG_ERROR( LOG_CATEGORY_L3, "Packet too short for IP header");
         g_ip_stats.header_errors++;
-        g_ip_stats.dropped_packets++;
+        ip_count_drop(packet, PACKET_DROP_IP_HEADER);
         return ERROR_PACKET_TOO_SHORT;
     }
     
-    /* Get IP version */
-    version = (packet->data[*offset] >> 4) & 0x0F;
+    /* Get IP version, from the header cache when it describes this offset */
+    if (packet_parsed_has(packet, PACKET_PARSED_L3) && packet_l3_offset(packet) == *offset) {
+        version = packet_has_proto(packet, PACKET_PROTO_IPV6) ? IP_VERSION_6 : IP_VERSION_4;
+    } else {
+        version = (packet->data[*offset] >> 4) & 0x0F;
+    }
     
     /* Update statistics */
     g_ip_stats.packets_processed++;
-    g_ip_stats.bytes_processed += packet->size - *offset;
+    g_ip_stats.bytes_processed += packet_chain_length(packet) - *offset;
+    
+    /* Established flows skip routing and neighbor lookup */
+    if (flow_cache_forward(packet, *offset, version, &status)) {
+        return status;
+    }
     
     /* Process according to IP version */
     switch (version) {
@@ -319,10 +567,11 @@ status_t ip_process_packet(packet_buffer_t *packet, uint16_t *offset) {
         default:
             LOG_ERROR( LOG_CATEGORY_L3, "Unsupported IP version: %d", version);
             g_ip_stats.header_errors++;
-            g_ip_stats.dropped_packets++;
+            ip_count_drop(packet, PACKET_DROP_IP_HEADER);
             status = ERROR_UNSUPPORTED_PROTOCOL;
             break;
     }
+    t_flow_pending.packet = NULL;
     
     return status;
 }
@@ -409,6 +658,8 @@ status_t ip_get_statistics(ip_stats_t *stats) {
     stats->forwarded_packets = g_ip_stats.forwarded_packets;
     stats->local_delivered = g_ip_stats.local_delivered;
     stats->dropped_packets = g_ip_stats.dropped_packets;
+    stats->flow_cache_hits = g_ip_stats.flow_cache_hits;
+    stats->flow_cache_misses = g_ip_stats.flow_cache_misses;
     
     return STATUS_SUCCESS;
 }
@@ -441,17 +692,17 @@ status_t ip_create_packet(const void *src_addr, const void *dst_addr, uint8_t pr
     uint16_t total_size = header_size + data_len;
     
     /* Allocate packet */
-    *packet = (packet_buffer_t *)malloc(sizeof(packet_buffer_t));
+    *packet = (packet_buffer_t *)mem_malloc(MEM_TAG_PACKET, sizeof(packet_buffer_t));
     if (!*packet) {
         LOG_ERROR( LOG_CATEGORY_L3, "Failed to allocate packet structure");
         return ERROR_OUT_OF_MEMORY;
     }
     
     /* Allocate packet data */
-    (*packet)->data = (uint8_t *)malloc(total_size);
+    (*packet)->data = (uint8_t *)mem_malloc(MEM_TAG_PACKET, total_size);
     if (!(*packet)->data) {
         LOG_ERROR( LOG_CATEGORY_L3, "Failed to allocate packet data");
-        free(*packet);
+        mem_free(MEM_TAG_PACKET, *packet);
         *packet = NULL;
         return ERROR_OUT_OF_MEMORY;
     }
@@ -460,6 +711,8 @@ status_t ip_create_packet(const void *src_addr, const void *dst_addr, uint8_t pr
     (*packet)->metadata.port = port_cpu_id();
     (*packet)->metadata.vlan = VLAN_ID_DEFAULT;
     (*packet)->metadata.priority = 0;
+    (*packet)->metadata.offload = 0;
+    (*packet)->metadata.tso_mss = 0;
     
     if (is_ipv6) {
         /* Construct IPv6 header */
@@ -493,8 +746,8 @@ status_t ip_create_packet(const void *src_addr, const void *dst_addr, uint8_t pr
         ipv4_hdr->src_addr = *(ipv4_addr_t *)src_addr;
         ipv4_hdr->dst_addr = *(ipv4_addr_t *)dst_addr;
         
-        /* Calculate header checksum */
-        ipv4_hdr->header_checksum = calculate_ipv4_checksum(ipv4_hdr, IPV4_HEADER_MIN_LEN);
+        /* The header checksum is filled on the way out, by the egress NIC if it can */
+        (*packet)->metadata.offload = PACKET_OFFLOAD_IP_CSUM;
         
         /* Copy payload data */
         if (data && data_len > 0) {
@@ -505,6 +758,76 @@ status_t ip_create_packet(const void *src_addr, const void *dst_addr, uint8_t pr
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Send a locally originated IP packet
+ *
+ * Routes the packet by its destination and sends it like a forwarded one,
+ * without using up a hop. The packet starts with its IP header; the caller
+ * keeps ownership of it, also when it is held for neighbor resolution.
+ *
+ * @param packet Packet to send
+ * @return STATUS_SUCCESS if sent, ERROR_PENDING_RESOLUTION if held,
+ *         other error code on failure
+ */
+status_t ip_output_packet(packet_buffer_t *packet) {
+    routing_table_t *routing_table;
+    route_entry_t route;
+    ip_addr_t dest_ip;
+    uint8_t version;
+
+    if (!packet) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    if (packet_peek_byte(packet, 0, &version) != STATUS_SUCCESS) {
+        return ERROR_PACKET_TOO_SHORT;
+    }
+
+    routing_table = routing_table_get_instance();
+    if (!routing_table) {
+        return ERROR_INTERNAL;
+    }
+
+    if ((version >> 4) == IP_VERSION_4) {
+        const ipv4_header_t *header = packet_peek_ptr(packet, 0, sizeof(*header));
+        if (!header) {
+            return ERROR_PACKET_TOO_SHORT;
+        }
+        dest_ip.type = IP_TYPE_V4;
+        dest_ip.addr.v4 = header->dst_addr;
+    } else if ((version >> 4) == IP_VERSION_6) {
+        const ipv6_header_t *header = packet_peek_ptr(packet, 0, sizeof(*header));
+        if (!header) {
+            return ERROR_PACKET_TOO_SHORT;
+        }
+        dest_ip.type = IP_TYPE_V6;
+        memcpy(&dest_ip.addr.v6, &header->dst_addr, sizeof(ipv6_addr_t));
+    } else {
+        return ERROR_UNSUPPORTED_PROTOCOL;
+    }
+
+    if (routing_table_lookup(routing_table, &dest_ip, dest_ip.type, &route) != STATUS_SUCCESS) {
+        return ERROR_NO_ROUTE;
+    }
+
+    return forward_ip_packet(packet, &route);
+}
+
+/**
+ * @brief Enable or disable the per-worker flow caches
+ *
+ * With the cache on, packets of flows a worker already routed are
+ * forwarded from its cache until the FIB, a neighbor or the MAC table
+ * changes. Off by default.
+ *
+ * @param enable true to forward established flows from the cache
+ * @return STATUS_SUCCESS
+ */
+status_t ip_set_flow_cache(bool enable) {
+    __atomic_store_n(&g_flow_cache_enabled, enable, __ATOMIC_RELAXED);
+    LOG_INFO(LOG_CATEGORY_L3, "IP flow cache %s", enable ? "enabled" : "disabled");
+    return STATUS_SUCCESS;
+}
+
 
 
 
@@ -544,6 +867,57 @@ static uint16_t calculate_ipv4_checksum(const void *data, size_t len) {
     return (uint16_t)~sum;
 }
 
+/**
+ * @brief Decrement the TTL of an IPv4 header and patch its checksum
+ *
+ * Uses the incremental update of RFC 1624, HC' = ~(~HC + ~m + m'), on the
+ * 16-bit word holding TTL and protocol instead of summing the whole header.
+ *
+ * @param header IPv4 header with TTL above zero
+ */
+static inline void ipv4_decrement_ttl(ipv4_header_t *header) {
+    uint16_t old_word, new_word;
+    uint32_t sum;
+
+    /* TTL and protocol form one word, in the same byte order as the checksum */
+    memcpy(&old_word, &header->ttl, sizeof(old_word));
+    header->ttl--;
+    memcpy(&new_word, &header->ttl, sizeof(new_word));
+
+    sum = (uint16_t)~header->header_checksum + (uint16_t)~old_word + new_word;
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    header->header_checksum = (uint16_t)~sum;
+}
+
+/**
+ * @brief Decrement the TTL of a forwarded IPv4 header
+ *
+ * A header whose checksum is left to the egress NIC only has its TTL
+ * changed; otherwise the checksum is patched incrementally.
+ *
+ * @param packet Packet carrying the header
+ * @param header IPv4 header with TTL above zero
+ * @param egress_offloads Offloads of the egress port, 0 if not known yet
+ */
+static inline void ipv4_forward_ttl(packet_buffer_t *packet, ipv4_header_t *header, uint32_t egress_offloads) {
+    if (egress_offloads & DRIVER_FLAG_TX_CSUM) {
+        packet->metadata.offload |= PACKET_OFFLOAD_IP_CSUM;
+    }
+    if (packet->metadata.offload & PACKET_OFFLOAD_IP_CSUM) {
+        header->ttl--;
+        return;
+    }
+    ipv4_decrement_ttl(header);
+}
+
+/**
+ * @brief Check if a received packet needs its IPv4 checksum verified
+ */
+static inline bool ipv4_needs_checksum(const packet_buffer_t *packet) {
+    return !(packet->metadata.offload & PACKET_OFFLOAD_RX_IP_GOOD);
+}
+
 /**
 * @brief Check if an IP address is local to this device
 * 
@@ -607,71 +981,120 @@ static bool is_local_address(const void *addr, bool is_ipv6) {
 /**
  * @brief Clean up stale fragment entries
  *
- * Removes expired fragment entries from the reassembly tables.
+ * Advances the expiry wheel to the current second and removes the entries
+ * that are due. Only the slots of the seconds elapsed since the last call
+ * are visited, and after a long pause each slot at most once.
  */
 static void cleanup_stale_fragments(void) {
-    uint32_t current_time = get_system_time_ms();
-    uint32_t timeout = FRAGMENT_REASSEMBLY_TIMEOUT;
+    uint32_t now = frag_now_sec();
+    uint32_t steps = now - g_frag_wheel_time;
 
-    // Clean up IPv4 fragment entries
-    ipv4_frag_entry_t *prev_ipv4 = NULL;
-    ipv4_frag_entry_t *curr_ipv4 = g_ipv4_frag_table;
-
-    while (curr_ipv4) {
-        if ((current_time - curr_ipv4->arrival_time) > timeout) {
-            ipv4_frag_entry_t *to_remove = curr_ipv4;
-
-            // Update the linked list
-            if (prev_ipv4) {
-                prev_ipv4->next = curr_ipv4->next;
-            } else {
-                g_ipv4_frag_table = curr_ipv4->next;
-            }
-
-            curr_ipv4 = curr_ipv4->next;
+    if (steps > IP_FRAG_WHEEL_SLOTS) {
+        steps = IP_FRAG_WHEEL_SLOTS;
+    }
 
-            // Free the resources
-            if (to_remove->reassembled_data) {
-                free(to_remove->reassembled_data);
+    for (uint32_t i = 1; i <= steps; i++) {
+        ip_frag_timer_t *timer = g_frag_wheel[(g_frag_wheel_time + i) & (IP_FRAG_WHEEL_SLOTS - 1)];
+        while (timer) {
+            ip_frag_timer_t *next = timer->next;
+            if ((int32_t)(now - timer->deadline) >= 0) {
+                if (timer->is_ipv6) {
+                    remove_ipv6_frag_entry((ipv6_frag_entry_t *)timer);
+                    LOG_DEBUG(LOG_CATEGORY_L3, "Removed stale IPv6 fragment entry");
+                } else {
+                    remove_ipv4_frag_entry((ipv4_frag_entry_t *)timer);
+                    LOG_DEBUG(LOG_CATEGORY_L3, "Removed stale IPv4 fragment entry");
+                }
+                ip_count_drop(NULL, PACKET_DROP_FRAGMENT);
             }
-            free(to_remove);
-
-            LOG_DEBUG(LOG_CATEGORY_L3, "Removed stale IPv4 fragment entry");
-        } else {
-            prev_ipv4 = curr_ipv4;
-            curr_ipv4 = curr_ipv4->next;
+            timer = next;
         }
     }
 
-    // Clean up IPv6 fragment entries
-    ipv6_frag_entry_t *prev_ipv6 = NULL;
-    ipv6_frag_entry_t *curr_ipv6 = g_ipv6_frag_table;
+    g_frag_wheel_time = now;
+}
 
-    while (curr_ipv6) {
-        if ((current_time - curr_ipv6->arrival_time) > timeout) {
-            ipv6_frag_entry_t *to_remove = curr_ipv6;
+/**
+ * @brief Monotonic time in seconds for reassembly expiry
+ */
+static uint32_t frag_now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec;
+}
 
-            // Update the linked list
-            if (prev_ipv6) {
-                prev_ipv6->next = curr_ipv6->next;
-            } else {
-                g_ipv6_frag_table = curr_ipv6->next;
-            }
+/**
+ * @brief Start the expiry timer of a new reassembly entry
+ *
+ * @param timer Timer of the entry
+ * @param is_ipv6 Family of the entry
+ * @param source_hash Hash of the source address, picks the memory account
+ */
+static void frag_timer_start(ip_frag_timer_t *timer, bool is_ipv6, uint32_t source_hash) {
+    ip_frag_timer_t **slot;
 
-            curr_ipv6 = curr_ipv6->next;
+    timer->deadline = frag_now_sec() + CONFIG_IP_FRAGMENT_TIMEOUT;
+    timer->charged = 0;
+    timer->source = (uint16_t)(source_hash & (IP_FRAG_SOURCE_BUCKETS - 1));
+    timer->is_ipv6 = is_ipv6;
 
-            // Free the resources
-            if (to_remove->reassembled_data) {
-                free(to_remove->reassembled_data);
-            }
-            free(to_remove);
+    slot = &g_frag_wheel[timer->deadline & (IP_FRAG_WHEEL_SLOTS - 1)];
+    timer->next = *slot;
+    timer->pprev = slot;
+    if (*slot) {
+        (*slot)->pprev = &timer->next;
+    }
+    *slot = timer;
+}
 
-            LOG_DEBUG(LOG_CATEGORY_L3, "Removed stale IPv6 fragment entry");
-        } else {
-            prev_ipv6 = curr_ipv6;
-            curr_ipv6 = curr_ipv6->next;
+/**
+ * @brief Stop the expiry timer of an entry and return its memory
+ *
+ * @param timer Timer of the entry
+ */
+static void frag_timer_stop(ip_frag_timer_t *timer) {
+    if (timer->pprev) {
+        *timer->pprev = timer->next;
+        if (timer->next) {
+            timer->next->pprev = timer->pprev;
         }
+        timer->pprev = NULL;
+    }
+
+    g_frag_source_bytes[timer->source] -= timer->charged;
+    timer->charged = 0;
+}
+
+/**
+ * @brief Charge reassembly memory to the source of an entry
+ *
+ * @param timer Timer of the entry
+ * @param bytes Bytes the entry is about to hold
+ * @return true if the source stays within IP_FRAG_SOURCE_MAX_BYTES
+ */
+static bool frag_source_charge(ip_frag_timer_t *timer, uint32_t bytes) {
+    if (g_frag_source_bytes[timer->source] + bytes > IP_FRAG_SOURCE_MAX_BYTES) {
+        return false;
     }
+
+    g_frag_source_bytes[timer->source] += bytes;
+    timer->charged += bytes;
+    return true;
+}
+
+
+/**
+ * @brief Bytes available from an offset to the end of a packet chain
+ *
+ * Clamped to the largest value an IP length field can describe.
+ *
+ * @param packet Packet
+ * @param offset Offset of the IP header
+ * @return Available length
+ */
+static uint16_t ip_available_length(const packet_buffer_t *packet, uint16_t offset) {
+    uint32_t length = packet_chain_length(packet) - offset;
+    return length > 0xFFFF ? 0xFFFF : (uint16_t)length;
 }
 
 
@@ -685,10 +1108,11 @@ static void cleanup_stale_fragments(void) {
  *
  * @param header Pointer to the IPv4 header
  * @param packet_len Total length of the packet buffer from the header
+ * @param verify_checksum False if the receiving NIC already verified it
  * @return STATUS_SUCCESS if header is valid
  *         ERROR_INVALID_HEADER if header fails validation
  */
-static status_t validate_ipv4_header(const ipv4_header_t *header, uint16_t packet_len) {
+static status_t validate_ipv4_header(const ipv4_header_t *header, uint16_t packet_len, bool verify_checksum) {
     uint16_t header_len;
     uint16_t total_len;
     uint16_t calculated_checksum;
@@ -715,6 +1139,9 @@ static status_t validate_ipv4_header(const ipv4_header_t *header, uint16_t packe
     }
 
     /* Validate checksum */
+    if (!verify_checksum) {
+        return STATUS_SUCCESS;
+    }
     calculated_checksum = calculate_ipv4_checksum(header, header_len);
     if (calculated_checksum != 0) {
         LOG_ERROR( LOG_CATEGORY_L3, "IPv4 header checksum failed: calculated=0x%04x", calculated_checksum);
@@ -724,88 +1151,533 @@ static status_t validate_ipv4_header(const ipv4_header_t *header, uint16_t packe
     return STATUS_SUCCESS;
 }
 
+#if defined(__SSE2__)
 /**
- * @brief Validate an IPv6 header
+ * @brief Check four 20-byte IPv4 headers at once
  *
- * Checks the IPv6 header for correct version and length.
+ * Each header's ten checksum words are widened into four 32-bit partial
+ * sums; a 4x4 transpose then leaves one header per lane, so folding and
+ * comparing the sums is vertical. Version/IHL and total length are
+ * checked on the first word of each header in the same lanes.
  *
- * @param header Pointer to the IPv6 header
- * @param packet_len Total length of the packet buffer from the header
- * @return STATUS_SUCCESS if header is valid
- *         ERROR_INVALID_HEADER if header fails validation
+ * @param headers Four headers, each readable for IPV4_HEADER_MIN_LEN bytes
+ * @param lengths Bytes available from each header
+ * @return Bit i set if header i has no options and passes every check
  */
-static status_t validate_ipv6_header(const ipv6_header_t *header, uint16_t packet_len) {
-    uint16_t payload_len;
+static inline uint32_t ipv4_check4_sse2(const ipv4_header_t *const *headers, const uint16_t *lengths) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sums[4];
+    uint32_t first[4];
+
+    for (int k = 0; k < 4; k++) {
+        const uint8_t *p = (const uint8_t *)headers[k];
+        uint32_t tail;
+
+        memcpy(&tail, p + 16, sizeof(tail));
+        memcpy(&first[k], p, sizeof(first[k]));
+        __m128i a = _mm_loadu_si128((const __m128i *)p);
+        __m128i t = _mm_cvtsi32_si128((int)tail);
+        sums[k] = _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(a, zero), _mm_unpackhi_epi16(a, zero)),
+                                _mm_unpacklo_epi16(t, zero));
+    }
+
+    __m128i u = _mm_add_epi32(_mm_unpacklo_epi32(sums[0], sums[1]), _mm_unpackhi_epi32(sums[0], sums[1]));
+    __m128i v = _mm_add_epi32(_mm_unpacklo_epi32(sums[2], sums[3]), _mm_unpackhi_epi32(sums[2], sums[3]));
+    __m128i sum = _mm_add_epi32(_mm_unpacklo_epi64(u, v), _mm_unpackhi_epi64(u, v));
+
+    // Ten words sum below 2^20, so two folds reach 16 bits
+    const __m128i low16 = _mm_set1_epi32(0xFFFF);
+    sum = _mm_add_epi32(_mm_and_si128(sum, low16), _mm_srli_epi32(sum, 16));
+    sum = _mm_add_epi32(_mm_and_si128(sum, low16), _mm_srli_epi32(sum, 16));
+    __m128i ok = _mm_cmpeq_epi32(sum, low16);
+
+    // First word: version_ihl in the low byte, total length big-endian in the high half
+    __m128i w = _mm_loadu_si128((const __m128i *)first);
+    ok = _mm_and_si128(ok, _mm_cmpeq_epi32(_mm_and_si128(w, _mm_set1_epi32(0xFF)),
+                                           _mm_set1_epi32((IP_VERSION_4 << 4) | (IPV4_HEADER_MIN_LEN / 4))));
+    __m128i total = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(w, 8), _mm_set1_epi32(0xFF00)),
+                                 _mm_srli_epi32(w, 24));
+    __m128i avail = _mm_setr_epi32(lengths[0], lengths[1], lengths[2], lengths[3]);
+    __m128i bad = _mm_or_si128(_mm_cmplt_epi32(total, _mm_set1_epi32(IPV4_HEADER_MIN_LEN)),
+                               _mm_cmpgt_epi32(total, avail));
+    ok = _mm_andnot_si128(bad, ok);
+
+    return (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(ok));
+}
+#endif
 
-    /* Validate IP version */
-    if ((ntohl(header->version_tc_flowlabel) >> 28) != IP_VERSION_6) {
-        LOG_ERROR( LOG_CATEGORY_L3, "Invalid IPv6 version: %d", ntohl(header->version_tc_flowlabel) >> 28);
-        return ERROR_INVALID_HEADER;
-    }
+#ifdef IP_VALIDATE_AVX2
+/**
+ * @brief Check eight 20-byte IPv4 headers at once
+ *
+ * Same steps as ipv4_check4_sse2(), with headers k and k + 4 sharing a
+ * register so that each 128-bit lane transposes its own four headers.
+ *
+ * @param headers Eight headers, each readable for IPV4_HEADER_MIN_LEN bytes
+ * @param lengths Bytes available from each header
+ * @return Bit i set if header i has no options and passes every check
+ */
+__attribute__((target("avx2")))
+static uint32_t ipv4_check8_avx2(const ipv4_header_t *const *headers, const uint16_t *lengths) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sums[4];
+    uint32_t first[8];
+    uint32_t tail[8];
+
+    for (int k = 0; k < 8; k++) {
+        memcpy(&first[k], headers[k], sizeof(first[k]));
+        memcpy(&tail[k], (const uint8_t *)headers[k] + 16, sizeof(tail[k]));
+    }
+    for (int k = 0; k < 4; k++) {
+        __m256i a = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)headers[k])),
+            _mm_loadu_si128((const __m128i *)headers[k + 4]), 1);
+        __m256i t = _mm256_setr_epi32((int)tail[k], 0, 0, 0, (int)tail[k + 4], 0, 0, 0);
+        sums[k] = _mm256_add_epi32(_mm256_add_epi32(_mm256_unpacklo_epi16(a, zero), _mm256_unpackhi_epi16(a, zero)),
+                                   _mm256_unpacklo_epi16(t, zero));
+    }
+
+    __m256i u = _mm256_add_epi32(_mm256_unpacklo_epi32(sums[0], sums[1]), _mm256_unpackhi_epi32(sums[0], sums[1]));
+    __m256i v = _mm256_add_epi32(_mm256_unpacklo_epi32(sums[2], sums[3]), _mm256_unpackhi_epi32(sums[2], sums[3]));
+    __m256i sum = _mm256_add_epi32(_mm256_unpacklo_epi64(u, v), _mm256_unpackhi_epi64(u, v));
+
+    const __m256i low16 = _mm256_set1_epi32(0xFFFF);
+    sum = _mm256_add_epi32(_mm256_and_si256(sum, low16), _mm256_srli_epi32(sum, 16));
+    sum = _mm256_add_epi32(_mm256_and_si256(sum, low16), _mm256_srli_epi32(sum, 16));
+    __m256i ok = _mm256_cmpeq_epi32(sum, low16);
+
+    __m256i w = _mm256_loadu_si256((const __m256i *)first);
+    ok = _mm256_and_si256(ok, _mm256_cmpeq_epi32(_mm256_and_si256(w, _mm256_set1_epi32(0xFF)),
+                                                 _mm256_set1_epi32((IP_VERSION_4 << 4) | (IPV4_HEADER_MIN_LEN / 4))));
+    __m256i total = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(w, 8), _mm256_set1_epi32(0xFF00)),
+                                    _mm256_srli_epi32(w, 24));
+    __m256i avail = _mm256_setr_epi32(lengths[0], lengths[1], lengths[2], lengths[3],
+                                      lengths[4], lengths[5], lengths[6], lengths[7]);
+    __m256i bad = _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(IPV4_HEADER_MIN_LEN), total),
+                                  _mm256_cmpgt_epi32(total, avail));
+    ok = _mm256_andnot_si256(bad, ok);
+
+    return (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(ok));
+}
+#endif
 
-    /* Validate payload length */
-    payload_len = ntohs(header->payload_len);
-    if (payload_len + sizeof(ipv6_header_t) > packet_len) {
-        LOG_ERROR( LOG_CATEGORY_L3, "IPv6 payload length exceeds packet buffer: payload=%d, packet=%d",
-                 payload_len, packet_len);
-        return ERROR_INVALID_HEADER;
+/**
+ * @brief Check whether a group of headers can be loaded whole by the vector checks
+ */
+static inline MAYBE_UNUSED bool ipv4_group_loadable(const ipv4_header_t *const *headers,
+                                                    const uint16_t *lengths, uint32_t n) {
+    for (uint32_t k = 0; k < n; k++) {
+        if (!headers[k] || lengths[k] < IPV4_HEADER_MIN_LEN) {
+            return false;
+        }
     }
-
-    return STATUS_SUCCESS;
+    return true;
 }
 
-
-
-/* --- HEADER PROCESSING -----------------------------------------------------*/
-
 /**
- * @brief Process IPv4 options in an IPv4 header
+ * @brief Validate a burst of IPv4 headers
  *
- * Processes any IPv4 header options and performs required actions.
+ * Headers without options are checked eight (AVX2, when the CPU has it)
+ * or four (SSE2) at a time. Every header the vector pass does not clear,
+ * including all headers with options, goes through validate_ipv4_header(),
+ * so the verdicts and error logs are the same as checking one at a time.
+ * TTL is left to the forwarding path, which answers an expired TTL with
+ * ICMP Time Exceeded instead of dropping it silently.
  *
- * @param header Pointer to the IPv4 header
- * @param packet Pointer to the packet structure
- * @return STATUS_SUCCESS if options processed successfully
- *         Various error codes on failure
+ * @param headers IPv4 headers
+ * @param lengths Bytes available from each header
+ * @param count Number of headers (at most 64)
+ * @return Drop mask: bit i set if headers[i] is malformed
  */
-static status_t process_ipv4_options(const ipv4_header_t *header, packet_buffer_t *packet) {
-    uint8_t header_len = (header->version_ihl & 0x0F) * 4;
-    uint8_t options_len = header_len - IPV4_HEADER_MIN_LEN;
-    const uint8_t *options = (const uint8_t *)header + IPV4_HEADER_MIN_LEN;
-    uint8_t i = 0;
+uint64_t validate_ipv4_headers_burst(const ipv4_header_t *const *headers, const uint16_t *lengths,
+                                     uint32_t count) {
+    uint64_t fast = 0;
+    uint64_t drop = 0;
+    uint32_t i = 0;
 
-    /* If no options, return success */
-    if (options_len == 0) {
-        return STATUS_SUCCESS;
+    if (!headers || !lengths) {
+        return 0;
+    }
+    if (count > IP_VALIDATE_BURST_MAX) {
+        count = IP_VALIDATE_BURST_MAX;
     }
 
-    LOG_DEBUG(LOG_CATEGORY_L3, "Processing IPv4 options, length=%d", options_len);
-
-    /* Process options */
-    while (i < options_len) {
-        uint8_t opt_type = options[i];
-        uint8_t opt_len;
+#ifdef IP_VALIDATE_AVX2
+    if (g_ipv4_validate_avx2) {
+        for (; i + 8 <= count; i += 8) {
+            if (ipv4_group_loadable(headers + i, lengths + i, 8)) {
+                fast |= (uint64_t)ipv4_check8_avx2(headers + i, lengths + i) << i;
+            }
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        if (ipv4_group_loadable(headers + i, lengths + i, 4)) {
+            fast |= (uint64_t)ipv4_check4_sse2(headers + i, lengths + i) << i;
+        }
+    }
+#endif
+    (void)i;
 
-        /* Handle one-byte options */
-        if (opt_type == 0) {  /* End of options */
-            break;
-        } else if (opt_type == 1) {  /* No operation */
-            i++;
+    for (uint32_t k = 0; k < count; k++) {
+        if (fast & (1ULL << k)) {
             continue;
         }
+        if (!headers[k] || lengths[k] < IPV4_HEADER_MIN_LEN ||
+            validate_ipv4_header(headers[k], lengths[k], true) != STATUS_SUCCESS) {
+            drop |= 1ULL << k;
+        }
+    }
 
-        /* Ensure we can read option length */
-        if (i + 1 >= options_len) {
-            LOG_ERROR( LOG_CATEGORY_L3, "Malformed IPv4 option: truncated at option type");
-            return ERROR_INVALID_OPTION;
+    return drop;
+}
+
+/**
+ * @brief IPv4 header check stage of the packet pipeline
+ *
+ * Drops IPv4 packets with a malformed header; everything else goes on.
+ * Headers whose checksum the receiving NIC verified skip the burst and
+ * only have their lengths checked.
+ */
+static void ip_validate_burst_stage(packet_buffer_t **pkts, uint32_t count, packet_result_t *results, void *user_data) {
+    const ipv4_header_t *headers[IP_VALIDATE_BURST_MAX];
+    uint16_t lengths[IP_VALIDATE_BURST_MAX];
+    uint8_t index[IP_VALIDATE_BURST_MAX];
+    uint32_t n = 0;
+
+    (void)user_data;
+    if (count > IP_VALIDATE_BURST_MAX) {
+        count = IP_VALIDATE_BURST_MAX;   // The pipeline never passes more than PACKET_BURST_MAX
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        packet_buffer_t *packet = pkts[i];
+
+        results[i] = PACKET_RESULT_FORWARD;
+        if (packet_ensure_parsed(packet) != STATUS_SUCCESS ||
+            !packet_has_proto(packet, PACKET_PROTO_IPV4)) {
+            continue;
+        }
+        const ipv4_header_t *header = (const ipv4_header_t *)packet_l3_header(packet);
+        uint16_t length = ip_available_length(packet, packet_l3_offset(packet));
+        if (!ipv4_needs_checksum(packet)) {
+            if (length < IPV4_HEADER_MIN_LEN ||
+                validate_ipv4_header(header, length, false) != STATUS_SUCCESS) {
+                results[i] = PACKET_RESULT_DROP;
+                g_ip_stats.header_errors++;
+                ip_count_drop(packet, PACKET_DROP_IP_HEADER);
+            }
+            continue;
         }
+        headers[n] = header;
+        lengths[n] = length;
+        index[n++] = (uint8_t)i;
+    }
 
-        opt_len = options[i + 1];
+    uint64_t drop = n ? validate_ipv4_headers_burst(headers, lengths, n) : 0;
+    for (uint32_t k = 0; k < n; k++) {
+        if (drop & (1ULL << k)) {
+            results[index[k]] = PACKET_RESULT_DROP;
+            g_ip_stats.header_errors++;
+            ip_count_drop(pkts[index[k]], PACKET_DROP_IP_HEADER);
+        }
+    }
+}
 
-        /* Validate option length */
-        if (opt_len < 2 || i + opt_len > options_len) {
-            LOG_ERROR( LOG_CATEGORY_L3, "Malformed IPv4 option: invalid length %d", opt_len);
-            return ERROR_INVALID_OPTION;
+/**
+ * @brief Whether the fused routing stage routes a packet
+ *
+ * Plain unicast IPv4 to the MAC of its ingress port, not for the switch
+ * itself and not from a port with a PBR policy. Everything else goes on
+ * down the pipeline untouched.
+ */
+static bool ip_route_eligible(packet_buffer_t *packet, port_id_t *mac_port, mac_addr_t *mac) {
+    const ipv4_header_t *header;
+    port_id_t in_port = packet->metadata.port;
+
+    if (packet_ensure_parsed(packet) != STATUS_SUCCESS ||
+        !packet_has_proto(packet, PACKET_PROTO_IPV4) ||
+        packet_has_proto(packet, PACKET_PROTO_IP_OPTIONS | PACKET_PROTO_IP_FRAG) ||
+        ip_available_length(packet, packet_l3_offset(packet)) < IPV4_HEADER_MIN_LEN ||
+        packet_l3_offset(packet) < sizeof(ethernet_header_t)) {
+        return false;
+    }
+
+    // Packets of a burst mostly share their ingress port
+    if (*mac_port != in_port) {
+        if (port_get_mac(in_port, mac) != STATUS_SUCCESS) {
+            return false;
+        }
+        *mac_port = in_port;
+    }
+    if (memcmp(packet->data, mac->addr, MAC_ADDR_LEN) != 0 || acl_pbr_attached(in_port)) {
+        return false;
+    }
+
+    header = (const ipv4_header_t *)packet_l3_header(packet);
+    const uint8_t *dst = (const uint8_t *)&header->dst_addr;
+    return (dst[0] & 0xF0) != 0xE0 && !is_local_address(&header->dst_addr, false);
+}
+
+/**
+ * @brief Fused IPv4 routing stage of the packet pipeline
+ *
+ * Routes a burst in passes instead of running each packet down
+ * ip_process_packet(): pick the routed packets and use up their hop, look
+ * all of their destinations up in one bulk FIB lookup, pick each one's
+ * path and neighbor rewrite (reused while consecutive packets share a
+ * next hop), put the rewrite in front of the IP header in place of the
+ * received L2 header, patch TTL and checksum in place, and queue the
+ * packets on their egress ports in one ring operation per port.
+ *
+ * Headers were checked by the ip-validate stage. Packets it cannot finish
+ * on its own (over the egress MTU) go on unchanged; expired packets and
+ * packets without a route get their ICMP error, and packets to an
+ * unresolved neighbor are held on it, as on the per-packet path.
+ */
+static void ip_route_burst_stage(packet_buffer_t **pkts, uint32_t count, packet_result_t *results, void *user_data) {
+    ip_addr_t dst[ROUTING_LOOKUP_BULK_MAX];
+    uint32_t nh_index[ROUTING_LOOKUP_BULK_MAX];
+    uint8_t index[ROUTING_LOOKUP_BULK_MAX];
+    port_id_t tx_port[PACKET_BURST_MAX];
+    packet_buffer_t *batch[PACKET_BURST_MAX];
+    port_id_t mac_port = PORT_ID_INVALID;
+    mac_addr_t mac;
+    uint64_t misses = 0;
+    uint32_t n = 0;
+    uint32_t pending = 0;
+
+    (void)user_data;
+    if (count > ROUTING_LOOKUP_BULK_MAX) {
+        count = ROUTING_LOOKUP_BULK_MAX;   // The pipeline never passes more than PACKET_BURST_MAX
+    }
+
+    // Pass 1: pick the routed packets; only they use up a hop
+    for (uint32_t i = 0; i < count; i++) {
+        packet_buffer_t *packet = pkts[i];
+
+        results[i] = PACKET_RESULT_FORWARD;
+        tx_port[i] = PORT_ID_INVALID;
+        if (!ip_route_eligible(packet, &mac_port, &mac)) {
+            continue;
+        }
+
+        const ipv4_header_t *header = (const ipv4_header_t *)packet_l3_header(packet);
+        g_ip_stats.packets_processed++;
+        g_ip_stats.bytes_processed += packet_chain_length(packet) - packet_l3_offset(packet);
+        g_ip_stats.ipv4_packets++;
+        if (header->ttl <= TTL_THRESHOLD) {
+            g_ip_stats.ttl_exceeded++;
+            ip_count_drop(packet, PACKET_DROP_TTL_EXCEEDED);
+            icmp_send_error(packet, packet_l3_offset(packet), ICMP_TYPE_TIME_EXCEEDED, ICMP_CODE_TTL_EXCEEDED, 0);
+            results[i] = PACKET_RESULT_DROP;
+            continue;
+        }
+
+        dst[n].type = IP_TYPE_V4;
+        dst[n].addr.v4 = header->dst_addr;
+        index[n++] = (uint8_t)i;
+    }
+    if (n == 0) {
+        return;
+    }
+
+    // Pass 2: every destination in one walk of the FIB
+    if (routing_lookup_bulk(dst, n, IP_TYPE_V4, nh_index, &misses) != STATUS_SUCCESS) {
+        misses = n < 64 ? (1ULL << n) - 1 : UINT64_MAX;
+    }
+
+    // Pass 3: path, adjacency and rewrite; the pipeline's read section keeps rewrites valid for the burst
+    const arp_rewrite_t *rewrite = NULL;
+    ipv4_addr_t rewrite_ip = 0;
+    port_id_t rewrite_port = PORT_ID_INVALID;
+
+    for (uint32_t k = 0; k < n; k++) {
+        uint32_t i = index[k];
+        packet_buffer_t *packet = pkts[i];
+        uint16_t l3_offset = packet_l3_offset(packet);
+        ip_addr_t next_hop;
+        uint16_t interface;
+        ipv4_addr_t neighbor;
+        status_t err;
+
+        if ((misses & (1ULL << k)) ||
+            routing_nexthop_select(nh_index[k], packet_flow_hash(packet), &next_hop, &interface) != STATUS_SUCCESS ||
+            interface >= MAX_PORTS) {
+            ip_count_drop(packet, PACKET_DROP_NO_ROUTE);
+            icmp_send_error(packet, l3_offset, ICMP_TYPE_DEST_UNREACH, ICMP_CODE_NET_UNREACH, 0);
+            results[i] = PACKET_RESULT_DROP;
+            continue;
+        }
+
+        // A connected route delivers to the destination itself
+        neighbor = next_hop.addr.v4 != 0 ? next_hop.addr.v4 : dst[k].addr.v4;
+        ipv4_header_t *header = (ipv4_header_t *)packet_l3_header(packet);
+        if (ntohs(header->total_length) > g_port_mtu_table[interface]) {
+            continue;
+        }
+
+        if (!rewrite || neighbor != rewrite_ip || interface != rewrite_port) {
+            rewrite = NULL;
+            err = arp_get_rewrite(&neighbor, interface, &rewrite);
+            if (err == STATUS_SUCCESS) {
+                rewrite_ip = neighbor;
+                rewrite_port = interface;
+            } else {
+                rewrite = NULL;
+            }
+        } else {
+            err = STATUS_SUCCESS;
+        }
+
+        if (err == ARP_STATUS_PENDING || err == ERROR_ENTRY_NOT_FOUND) {
+            // The neighbor keeps its own copy of the IP packet until the reply
+            if (packet_pull_header(packet, l3_offset, NULL) == STATUS_SUCCESS &&
+                arp_queue_packet(arp_table_get_instance(), &neighbor, interface, packet) == ARP_STATUS_PENDING) {
+                packet_invalidate_parse(packet);
+                results[i] = PACKET_RESULT_DROP;
+                continue;
+            }
+            err = ERROR_ENTRY_NOT_FOUND;
+        }
+        if (err != STATUS_SUCCESS) {
+            ip_count_drop(packet, PACKET_DROP_NEIGHBOR);
+            results[i] = PACKET_RESULT_DROP;
+            continue;
+        }
+
+        // The rewrite takes the place of the received L2 header
+        if (rewrite->len > l3_offset) {
+            err = packet_push_header(packet, rewrite->len - l3_offset, NULL);
+        } else if (rewrite->len < l3_offset) {
+            err = packet_pull_header(packet, l3_offset - rewrite->len, NULL);
+        } else {
+            err = packet_make_writable(packet);
+        }
+        if (err != STATUS_SUCCESS) {
+            ip_count_drop(packet, PACKET_DROP_INTERNAL);
+            results[i] = PACKET_RESULT_DROP;
+            continue;
+        }
+        memcpy(packet->data, rewrite->bytes, rewrite->len);
+        header = (ipv4_header_t *)(packet->data + rewrite->len);
+        ipv4_forward_ttl(packet, header, hw_sim_get_port_offloads(interface));
+        packet_invalidate_parse(packet);
+
+        g_ip_stats.forwarded_packets++;
+        results[i] = PACKET_RESULT_CONSUME;
+        tx_port[i] = interface;
+        pending++;
+    }
+
+    // Pass 4: one ring operation per egress port, packets in burst order
+    for (uint32_t i = 0; pending > 0 && i < count; i++) {
+        port_id_t port = tx_port[i];
+        uint32_t grouped = 0, queued;
+
+        if (port == PORT_ID_INVALID) {
+            continue;
+        }
+        for (uint32_t j = i; j < count; j++) {
+            if (tx_port[j] == port) {
+                batch[grouped++] = pkts[j];
+                tx_port[j] = PORT_ID_INVALID;
+            }
+        }
+        pending -= grouped;
+
+        // The ring owns what it took
+        queued = hw_sim_tx_enqueue_burst(port, batch, grouped);
+        for (uint32_t j = queued; j < grouped; j++) {
+            ip_count_drop(batch[j], PACKET_DROP_TX_RING_FULL);
+            packet_buffer_free(batch[j]);
+        }
+        g_ip_stats.forwarded_packets -= grouped - queued;
+    }
+}
+
+/**
+ * @brief Validate an IPv6 header
+ *
+ * Checks the IPv6 header for correct version and length.
+ *
+ * @param header Pointer to the IPv6 header
+ * @param packet_len Total length of the packet buffer from the header
+ * @return STATUS_SUCCESS if header is valid
+ *         ERROR_INVALID_HEADER if header fails validation
+ */
+static status_t validate_ipv6_header(const ipv6_header_t *header, uint16_t packet_len) {
+    uint16_t payload_len;
+
+    /* Validate IP version */
+    if ((ntohl(header->version_tc_flowlabel) >> 28) != IP_VERSION_6) {
+        LOG_ERROR( LOG_CATEGORY_L3, "Invalid IPv6 version: %d", ntohl(header->version_tc_flowlabel) >> 28);
+        return ERROR_INVALID_HEADER;
+    }
+
+    /* Validate payload length */
+    payload_len = ntohs(header->payload_len);
+    if (payload_len + sizeof(ipv6_header_t) > packet_len) {
+        LOG_ERROR( LOG_CATEGORY_L3, "IPv6 payload length exceeds packet buffer: payload=%d, packet=%d",
+                 payload_len, packet_len);
+        return ERROR_INVALID_HEADER;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+
+
+/* --- HEADER PROCESSING -----------------------------------------------------*/
+
+/**
+ * @brief Process IPv4 options in an IPv4 header
+ *
+ * Processes any IPv4 header options and performs required actions.
+ *
+ * @param header Pointer to the IPv4 header
+ * @param packet Pointer to the packet structure
+ * @return STATUS_SUCCESS if options processed successfully
+ *         Various error codes on failure
+ */
+static status_t process_ipv4_options(const ipv4_header_t *header, packet_buffer_t *packet) {
+    uint8_t header_len = (header->version_ihl & 0x0F) * 4;
+    uint8_t options_len = header_len - IPV4_HEADER_MIN_LEN;
+    const uint8_t *options = (const uint8_t *)header + IPV4_HEADER_MIN_LEN;
+    uint8_t i = 0;
+
+    /* If no options, return success */
+    if (options_len == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    LOG_DEBUG(LOG_CATEGORY_L3, "Processing IPv4 options, length=%d", options_len);
+
+    /* Process options */
+    while (i < options_len) {
+        uint8_t opt_type = options[i];
+        uint8_t opt_len;
+
+        /* Handle one-byte options */
+        if (opt_type == 0) {  /* End of options */
+            break;
+        } else if (opt_type == 1) {  /* No operation */
+            i++;
+            continue;
+        }
+
+        /* Ensure we can read option length */
+        if (i + 1 >= options_len) {
+            LOG_ERROR( LOG_CATEGORY_L3, "Malformed IPv4 option: truncated at option type");
+            return ERROR_INVALID_OPTION;
+        }
+
+        opt_len = options[i + 1];
+
+        /* Validate option length */
+        if (opt_len < 2 || i + opt_len > options_len) {
+            LOG_ERROR( LOG_CATEGORY_L3, "Malformed IPv4 option: invalid length %d", opt_len);
+            return ERROR_INVALID_OPTION;
         }
 
         /* Process specific options */
@@ -849,6 +1721,7 @@ static status_t process_ipv4_options(const ipv4_header_t *header, packet_buffer_
 static status_t process_ipv6_extension_headers(packet_buffer_t *packet, uint16_t *offset, ipv6_ext_headers_ctx_t *ctx) {
     uint8_t current_header = ctx->current_header;
     uint16_t current_offset = *offset;
+    uint16_t nh_field_offset = current_offset - IPV6_HEADER_LEN + 6;  /* Next Header of the fixed header */
     bool done = false;
 
     while (!done) {
@@ -880,6 +1753,7 @@ static status_t process_ipv6_extension_headers(packet_buffer_t *packet, uint16_t
                     }
                 }
 
+                nh_field_offset = current_offset;
                 current_header = next_header;
                 current_offset += total_len;
                 break;
@@ -891,12 +1765,26 @@ static status_t process_ipv6_extension_headers(packet_buffer_t *packet, uint16_t
                     return ERROR_INVALID_HEADER;
                 }
 
-                ctx->has_fragment_header = true;
                 uint8_t next_header = packet->data[current_offset];
-                /* Fragment header processing would be implemented here */
+                uint16_t offset_flags;
+                uint32_t ident;
+                memcpy(&offset_flags, packet->data + current_offset + 2, sizeof(offset_flags));
+                memcpy(&ident, packet->data + current_offset + 4, sizeof(ident));
 
+                ctx->has_fragment_header = true;
+                ctx->frag_hdr_offset = current_offset;
+                ctx->frag_prev_nh_offset = nh_field_offset;
+                ctx->frag_offset_flags = ntohs(offset_flags);
+                ctx->frag_ident = ntohl(ident);
+
+                nh_field_offset = current_offset;
                 current_header = next_header;
-                current_offset += 8;  /* Fragment header is always 8 bytes */
+                current_offset += IPV6_FRAG_HEADER_LEN;
+
+                /* Beyond a real fragment's header lies payload, not more headers */
+                if (ctx->frag_offset_flags & (IPV6_FRAG_OFFSET_MASK | IPV6_FRAG_FLAG_M)) {
+                    done = true;
+                }
                 break;
             }
 
@@ -915,6 +1803,7 @@ static status_t process_ipv6_extension_headers(packet_buffer_t *packet, uint16_t
                     return ERROR_INVALID_HEADER;
                 }
 
+                nh_field_offset = current_offset;
                 current_header = next_header;
                 current_offset += total_len;
                 break;
@@ -944,6 +1833,50 @@ static status_t process_ipv6_extension_headers(packet_buffer_t *packet, uint16_t
 
 /* --- FRAGMENTATION ---------------------------------------------------------*/
 
+/**
+ * @brief Finalize a reassembly hash
+ *
+ * @param hash Hash accumulated over the key words
+ * @return Well-mixed hash
+ */
+static uint32_t frag_mix(uint32_t hash) {
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6BU;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35U;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/**
+ * @brief Hash of an IPv4 reassembly key
+ */
+static uint32_t frag_hash_ipv4(ipv4_addr_t src, ipv4_addr_t dst, uint16_t ident, uint8_t protocol) {
+    uint32_t hash = g_frag_hash_seed;
+
+    hash = frag_mix(hash ^ src);
+    hash = frag_mix(hash ^ dst);
+    return frag_mix(hash ^ ((uint32_t)ident << 8 | protocol));
+}
+
+/**
+ * @brief Hash of an IPv6 reassembly key
+ */
+static uint32_t frag_hash_ipv6(const ipv6_addr_t *src, const ipv6_addr_t *dst, uint32_t ident) {
+    uint32_t hash = g_frag_hash_seed;
+    uint32_t word;
+
+    for (int i = 0; i < 16; i += 4) {
+        memcpy(&word, &src->addr[i], sizeof(word));
+        hash = frag_mix(hash ^ word);
+    }
+    for (int i = 0; i < 16; i += 4) {
+        memcpy(&word, &dst->addr[i], sizeof(word));
+        hash = frag_mix(hash ^ word);
+    }
+    return frag_mix(hash ^ ident);
+}
+
 /**
  * @brief Find an IPv4 fragment entry
  *
@@ -953,7 +1886,9 @@ static status_t process_ipv6_extension_headers(packet_buffer_t *packet, uint16_t
  * @return Pointer to the fragment entry if found, NULL otherwise
  */
 static ipv4_frag_entry_t *find_ipv4_frag_entry(const ipv4_header_t *header) {
-    ipv4_frag_entry_t *entry = g_ipv4_frag_table;
+    uint32_t hash = frag_hash_ipv4(header->src_addr, header->dst_addr, ntohs(header->identification),
+                                   header->protocol);
+    ipv4_frag_entry_t *entry = g_ipv4_frag_table[hash & (IP_FRAG_HASH_SIZE - 1)];
 
     while (entry) {
         if (entry->src_addr == header->src_addr &&
@@ -979,7 +1914,7 @@ static ipv4_frag_entry_t *find_ipv4_frag_entry(const ipv4_header_t *header) {
  * @return Pointer to the fragment entry if found, NULL otherwise
  */
 static ipv6_frag_entry_t *find_ipv6_frag_entry(const ipv6_addr_t *src, const ipv6_addr_t *dst, uint32_t ident) {
-    ipv6_frag_entry_t *entry = g_ipv6_frag_table;
+    ipv6_frag_entry_t *entry = g_ipv6_frag_table[frag_hash_ipv6(src, dst, ident) & (IP_FRAG_HASH_SIZE - 1)];
 
     while (entry) {
         if (memcmp(&entry->src_addr, src, sizeof(ipv6_addr_t)) == 0 &&
@@ -994,169 +1929,472 @@ static ipv6_frag_entry_t *find_ipv6_frag_entry(const ipv6_addr_t *src, const ipv
 }
 
 /**
- * @brief Reassemble IPv4 fragments
+ * @brief Create an IPv4 fragment entry
  *
- * Attempts to reassemble IPv4 fragments into a complete packet.
+ * The entry is linked into its bucket, its expiry timer is started and its
+ * size is charged to the source.
  *
- * @param entry Pointer to the fragment entry containing fragment information
- * @param reassembled Packet to store the reassembled data
- * @return STATUS_SUCCESS if reassembly is successful or in progress
- *         ERROR_REASSEMBLY_FAILED if reassembly fails
+ * @param header IPv4 header of the first fragment received
+ * @return The new entry, or NULL if out of memory or over the source's budget
  */
-//static status_t reassemble_ipv4_fragments(ipv4_frag_entry_t *entry, packet_t *reassembled) {
-static status_t reassemble_ipv4_fragments(ipv4_frag_entry_t *entry, packet_t **reassembled) {
-    if (!entry || !reassembled) {
-        return ERROR_INVALID_PARAMETER;
+static ipv4_frag_entry_t *create_ipv4_frag_entry(const ipv4_header_t *header) {
+    ipv4_frag_entry_t *entry = (ipv4_frag_entry_t *)mem_malloc(MEM_TAG_IP, sizeof(ipv4_frag_entry_t));
+    if (!entry) {
+        return NULL;
+    }
+
+    memset(entry, 0, sizeof(ipv4_frag_entry_t));
+    entry->src_addr = header->src_addr;
+    entry->dst_addr = header->dst_addr;
+    entry->ident = ntohs(header->id);
+    entry->protocol = header->protocol;
+
+    frag_timer_start(&entry->timer, false, frag_mix(header->src_addr ^ g_frag_hash_seed));
+    if (!frag_source_charge(&entry->timer, sizeof(ipv4_frag_entry_t))) {
+        frag_timer_stop(&entry->timer);
+        mem_free(MEM_TAG_IP, entry);
+        return NULL;
+    }
+
+    ipv4_frag_entry_t **bucket = &g_ipv4_frag_table[frag_hash_ipv4(entry->src_addr, entry->dst_addr,
+                                                                   entry->ident, entry->protocol) &
+                                                    (IP_FRAG_HASH_SIZE - 1)];
+    entry->next = *bucket;
+    *bucket = entry;
+    return entry;
+}
+
+/**
+ * @brief Create an IPv6 fragment entry
+ *
+ * @param header IPv6 header of the first fragment received
+ * @param ident Fragment identification
+ * @return The new entry, or NULL if out of memory or over the source's budget
+ */
+static ipv6_frag_entry_t *create_ipv6_frag_entry(const ipv6_header_t *header, uint32_t ident) {
+    ipv6_frag_entry_t *entry = (ipv6_frag_entry_t *)mem_malloc(MEM_TAG_IP, sizeof(ipv6_frag_entry_t));
+    if (!entry) {
+        return NULL;
+    }
+
+    memset(entry, 0, sizeof(ipv6_frag_entry_t));
+    memcpy(&entry->src_addr, &header->src_addr, sizeof(ipv6_addr_t));
+    memcpy(&entry->dst_addr, &header->dst_addr, sizeof(ipv6_addr_t));
+    entry->ident = ident;
+
+    /* The account follows the /64 of the source, as one host picks any address in it */
+    uint32_t prefix[2];
+    memcpy(prefix, entry->src_addr.addr, sizeof(prefix));
+    frag_timer_start(&entry->timer, true, frag_mix(frag_mix(prefix[0] ^ g_frag_hash_seed) ^ prefix[1]));
+    if (!frag_source_charge(&entry->timer, sizeof(ipv6_frag_entry_t))) {
+        frag_timer_stop(&entry->timer);
+        mem_free(MEM_TAG_IP, entry);
+        return NULL;
+    }
+
+    ipv6_frag_entry_t **bucket = &g_ipv6_frag_table[frag_hash_ipv6(&entry->src_addr, &entry->dst_addr,
+                                                                   entry->ident) &
+                                                    (IP_FRAG_HASH_SIZE - 1)];
+    entry->next = *bucket;
+    *bucket = entry;
+    return entry;
+}
+
+/**
+ * @brief Add a fragment to a reassembly queue
+ *
+ * The fragment payload is kept as a slice of the packet, so the caller
+ * still owns (and may free) the packet. Overlapping and duplicate
+ * fragments are rejected.
+ *
+ * @param queue Reassembly queue
+ * @param packet Received fragment
+ * @param l3_offset Offset of the IP header in the packet
+ * @param headers_len Bytes before the fragmentable part (kept from the first fragment)
+ * @param payload_offset Offset of the fragment payload in the packet
+ * @param frag_offset Offset of the payload within the original datagram
+ * @param data_len Payload length
+ * @param last True if this is the last fragment
+ * @return STATUS_SUCCESS if the fragment was queued
+ *         ERROR_PACKET_MALFORMED if it conflicts with queued fragments
+ */
+static status_t frag_queue_insert(ip_frag_queue_t *queue, const packet_buffer_t *packet,
+                                  uint16_t l3_offset, uint16_t headers_len, uint16_t payload_offset,
+                                  uint32_t frag_offset, uint32_t data_len, bool last) {
+    uint32_t end = frag_offset + data_len;
+    uint16_t pos = 0;
+
+    if (data_len == 0 || (!last && (data_len % IP_FRAGMENT_UNIT) != 0) ||
+        payload_offset - l3_offset + end > 0xFFFF) {
+        return ERROR_PACKET_MALFORMED;
     }
 
-    // Check if all fragments are received
-    bool complete = true;
-    uint16_t max_offset = 0;
+    if (queue->fragment_count >= MAX_FRAGMENTS) {
+        return ERROR_INVALID_PACKET;
+    }
 
-    for (int i = 0; i < MAX_FRAGMENTS; i++) {
-        if (entry->fragments[i]) {
-            uint16_t offset = i * IP_FRAGMENT_UNIT;
-            if (offset > max_offset) {
-                max_offset = offset;
+    if (last) {
+        if (queue->total_length != 0 && queue->total_length != end) {
+            return ERROR_PACKET_MALFORMED;
+        }
+        if (queue->fragment_count > 0) {
+            uint16_t i = queue->fragment_count - 1;
+            if ((uint32_t)queue->frag_offsets[i] + queue->frag_lengths[i] > end) {
+                return ERROR_PACKET_MALFORMED;
             }
-        } else if (i * IP_FRAGMENT_UNIT < entry->total_length) {
-            // This fragment is missing and is within the expected packet length
-            complete = false;
-            break;
         }
+    } else if (queue->total_length != 0 && end > queue->total_length) {
+        return ERROR_PACKET_MALFORMED;
     }
 
-    // If the last fragment has the MF flag cleared, we know the total length
-    if (!(entry->fragment_flags & IP_FLAG_MF) && complete) {
-        // All fragments received, reassemble the packet
+    while (pos < queue->fragment_count && queue->frag_offsets[pos] < frag_offset) {
+        pos++;
+    }
+    if (pos > 0 && (uint32_t)queue->frag_offsets[pos - 1] + queue->frag_lengths[pos - 1] > frag_offset) {
+        return ERROR_PACKET_MALFORMED;
+    }
+    if (pos < queue->fragment_count && queue->frag_offsets[pos] < end) {
+        return ERROR_PACKET_MALFORMED;
+    }
 
-        // Allocate memory for the reassembled packet if not already done
-        if (!entry->reassembled_data) {
-            entry->reassembled_data = (uint8_t *)malloc(entry->total_length);
-            if (!entry->reassembled_data) {
-                LOG_ERROR( LOG_CATEGORY_L3, "Failed to allocate memory for reassembled IPv4 packet");
-                return ERROR_MEMORY_ALLOCATION_FAILED;
-            }
+    if (frag_offset == 0) {
+        if (headers_len > IP_FRAG_HEADERS_MAX ||
+            packet_copy_data(packet, 0, queue->headers, headers_len) != STATUS_SUCCESS) {
+            return ERROR_PACKET_MALFORMED;
         }
+        queue->headers_len = headers_len;
+        queue->l3_offset = l3_offset;
+        queue->metadata = packet->metadata;
+    }
 
-        // Copy the fragments to the reassembled packet
-        ipv4_header_t *header = (ipv4_header_t *)entry->reassembled_data;
+    packet_buffer_t *slice = packet_buffer_slice(packet, payload_offset, data_len);
+    if (!slice) {
+        return ERROR_OUT_OF_MEMORY;
+    }
 
-        // Set up basic header fields
-        header->version_ihl = (IP_VERSION_4 << 4) | (IPV4_HEADER_MIN_LEN / 4);
-        header->tos = 0;
-        header->total_length = htons(entry->total_length);
-        header->identification = htons(entry->ident);
-        header->flags_fragment_offset = 0; // No fragmentation in reassembled packet
-        header->ttl = TTL_DEFAULT;
-        header->protocol = entry->protocol;
-        header->header_checksum = 0;
-        header->src_addr = entry->src_addr;
-        header->dst_addr = entry->dst_addr;
+    uint16_t tail = queue->fragment_count - pos;
+    memmove(&queue->frag_offsets[pos + 1], &queue->frag_offsets[pos], tail * sizeof(queue->frag_offsets[0]));
+    memmove(&queue->frag_lengths[pos + 1], &queue->frag_lengths[pos], tail * sizeof(queue->frag_lengths[0]));
+    memmove(&queue->fragments[pos + 1], &queue->fragments[pos], tail * sizeof(queue->fragments[0]));
+    queue->frag_offsets[pos] = (uint16_t)frag_offset;
+    queue->frag_lengths[pos] = (uint16_t)data_len;
+    queue->fragments[pos] = slice;
+    queue->fragment_count++;
+    queue->received_length += data_len;
 
-        // Recalculate the checksum
-        header->header_checksum = calculate_ipv4_checksum(header, IPV4_HEADER_MIN_LEN);
+    if (last) {
+        queue->total_length = end;
+    }
 
-        // Copy the reassembled data to the output packet
-        if (!reassembled || !*reassembled) {
-            return ERROR_INVALID_PARAMETER;
-        }
-        packet_reset(*reassembled);
-        if (packet_append_data(*reassembled, entry->reassembled_data, entry->total_length) != STATUS_SUCCESS) {
-            LOG_ERROR( LOG_CATEGORY_L3, "Failed to append reassembled IPv4 data to packet");
-            return ERROR_PACKET_OPERATION_FAILED;
-        }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Link the fragments of a complete queue into one packet
+ *
+ * The packet starts with a segment holding the first fragment's headers,
+ * followed by the payload slices in order; no payload is copied. The
+ * queue gives up its slices.
+ *
+ * @param queue Complete reassembly queue
+ * @return Reassembled packet, or NULL if the queue is incomplete or allocation fails
+ */
+static packet_buffer_t *frag_queue_build(ip_frag_queue_t *queue) {
+    if (queue->headers_len == 0 || queue->total_length == 0 ||
+        queue->received_length != queue->total_length) {
+        return NULL;
+    }
 
-        // Update statistics
-        g_ip_stats.reassembled_packets++;
+    packet_buffer_t *head = packet_segment_alloc();
+    if (!head) {
+        return NULL;
+    }
 
-        LOG_DEBUG(LOG_CATEGORY_L3, "Successfully reassembled IPv4 packet (ID: %u)", entry->ident);
-        return STATUS_SUCCESS;
+    if (packet_append_data(head, queue->headers, queue->headers_len) != STATUS_SUCCESS) {
+        packet_buffer_free(head);
+        return NULL;
     }
+    head->metadata = queue->metadata;
+    packet_invalidate_parse(head);
 
-    // Reassembly still in progress
-    return ERROR_REASSEMBLY_IN_PROGRESS;
+    for (uint16_t i = 0; i < queue->fragment_count; i++) {
+        packet_chain_append(head, queue->fragments[i]);
+        queue->fragments[i] = NULL;
+    }
+    queue->fragment_count = 0;
+    queue->received_length = 0;
+
+    return head;
+}
+
+/**
+ * @brief Release the fragments held by a reassembly queue
+ *
+ * @param queue Reassembly queue
+ */
+static void frag_queue_release(ip_frag_queue_t *queue) {
+    for (uint16_t i = 0; i < queue->fragment_count; i++) {
+        packet_buffer_free(queue->fragments[i]);
+    }
+    queue->fragment_count = 0;
+    queue->received_length = 0;
+}
+
+/**
+ * @brief Unlink and free an IPv4 fragment entry
+ *
+ * @param entry Entry in g_ipv4_frag_table
+ */
+static void remove_ipv4_frag_entry(ipv4_frag_entry_t *entry) {
+    ipv4_frag_entry_t **link = &g_ipv4_frag_table[frag_hash_ipv4(entry->src_addr, entry->dst_addr,
+                                                                 entry->ident, entry->protocol) &
+                                                  (IP_FRAG_HASH_SIZE - 1)];
+
+    while (*link && *link != entry) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        *link = entry->next;
+    }
+
+    frag_timer_stop(&entry->timer);
+    frag_queue_release(&entry->queue);
+    mem_free(MEM_TAG_IP, entry);
+}
+
+/**
+ * @brief Unlink and free an IPv6 fragment entry
+ *
+ * @param entry Entry in g_ipv6_frag_table
+ */
+static void remove_ipv6_frag_entry(ipv6_frag_entry_t *entry) {
+    ipv6_frag_entry_t **link = &g_ipv6_frag_table[frag_hash_ipv6(&entry->src_addr, &entry->dst_addr,
+                                                                 entry->ident) &
+                                                  (IP_FRAG_HASH_SIZE - 1)];
+
+    while (*link && *link != entry) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        *link = entry->next;
+    }
+
+    frag_timer_stop(&entry->timer);
+    frag_queue_release(&entry->queue);
+    mem_free(MEM_TAG_IP, entry);
+}
+
+/**
+ * @brief Reassemble IPv4 fragments
+ *
+ * Once every fragment has arrived, links them into a single packet whose
+ * IPv4 header is rewritten as unfragmented.
+ *
+ * @param entry Pointer to the fragment entry containing fragment information
+ * @param reassembled Receives the reassembled packet, owned by the caller
+ * @return STATUS_SUCCESS if reassembly is complete
+ *         ERROR_REASSEMBLY_IN_PROGRESS if fragments are still missing
+ *         ERROR_OUT_OF_MEMORY if the packet could not be built
+ */
+static status_t reassemble_ipv4_fragments(ipv4_frag_entry_t *entry, packet_t **reassembled) {
+    if (!entry || !reassembled) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    ip_frag_queue_t *queue = &entry->queue;
+    if (queue->headers_len == 0 || queue->total_length == 0 ||
+        queue->received_length != queue->total_length) {
+        return ERROR_REASSEMBLY_IN_PROGRESS;
+    }
+
+    packet_buffer_t *packet = frag_queue_build(queue);
+    if (!packet) {
+        LOG_ERROR( LOG_CATEGORY_L3, "Failed to build reassembled IPv4 packet");
+        return ERROR_OUT_OF_MEMORY;
+    }
+
+    // The headers are all in the first segment
+    ipv4_header_t *header = (ipv4_header_t *)(packet->data + queue->l3_offset);
+    uint16_t header_len = (header->version_ihl & 0x0F) * 4;
+    header->total_length = htons(header_len + queue->total_length);
+    header->flags_fragment_offset &= htons(IP_FLAG_DF);
+    header->header_checksum = 0;
+    header->header_checksum = calculate_ipv4_checksum(header, header_len);
+
+    g_ip_stats.reassembled_packets++;
+    LOG_DEBUG(LOG_CATEGORY_L3, "Successfully reassembled IPv4 packet (ID: %u)", entry->ident);
+
+    *reassembled = packet;
+    return STATUS_SUCCESS;
 }
 
 /**
  * @brief Reassemble IPv6 fragments
  *
- * Attempts to reassemble IPv6 fragments into a complete packet.
+ * Once every fragment has arrived, links them into a single packet with
+ * the Fragment header removed from the unfragmentable part.
  *
  * @param entry Pointer to the fragment entry containing fragment information
- * @param reassembled Packet to store the reassembled data
- * @return STATUS_SUCCESS if reassembly is successful or in progress
- *         ERROR_REASSEMBLY_FAILED if reassembly fails
+ * @param reassembled Receives the reassembled packet, owned by the caller
+ * @return STATUS_SUCCESS if reassembly is complete
+ *         ERROR_REASSEMBLY_IN_PROGRESS if fragments are still missing
+ *         ERROR_OUT_OF_MEMORY if the packet could not be built
  */
-//static status_t reassemble_ipv6_fragments(ipv6_frag_entry_t *entry, packet_t *reassembled) {
 static status_t reassemble_ipv6_fragments(ipv6_frag_entry_t *entry, packet_t **reassembled) {
     if (!entry || !reassembled) {
         return ERROR_INVALID_PARAMETER;
     }
 
-    // Check if all fragments are received
-    bool complete = true;
-    uint16_t max_offset = 0;
+    ip_frag_queue_t *queue = &entry->queue;
+    if (queue->headers_len == 0 || queue->total_length == 0 ||
+        queue->received_length != queue->total_length) {
+        return ERROR_REASSEMBLY_IN_PROGRESS;
+    }
 
-    for (int i = 0; i < MAX_FRAGMENTS; i++) {
-        if (entry->fragments[i]) {
-            uint16_t offset = i * IP_FRAGMENT_UNIT;
-            if (offset > max_offset) {
-                max_offset = offset;
-            }
-        } else if (i * IP_FRAGMENT_UNIT < entry->total_length) {
-            // This fragment is missing and is within the expected packet length
-            complete = false;
-            break;
+    packet_buffer_t *packet = frag_queue_build(queue);
+    if (!packet) {
+        LOG_ERROR( LOG_CATEGORY_L3, "Failed to build reassembled IPv6 packet");
+        return ERROR_OUT_OF_MEMORY;
+    }
+
+    ipv6_header_t *header = (ipv6_header_t *)(packet->data + queue->l3_offset);
+    uint16_t ext_len = queue->headers_len - queue->l3_offset - IPV6_HEADER_LEN;
+    header->payload_length = htons(ext_len + queue->total_length);
+    packet->data[entry->prev_nh_offset] = entry->next_header;
+
+    g_ip_stats.reassembled_packets++;
+    LOG_DEBUG(LOG_CATEGORY_L3, "Successfully reassembled IPv6 packet (ID: %u)", entry->ident);
+
+    *reassembled = packet;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Build one outgoing fragment
+ *
+ * The fragment is a header segment, holding the L2 rewrite when the next
+ * hop is resolved and the fragment's own L3 headers, followed by a
+ * zero-copy slice of the original payload. Full bursts are flushed.
+ *
+ * @param tx Fragments of the datagram
+ * @param packet Datagram being fragmented
+ * @param headers L3 header of the fragment
+ * @param headers_len Length of headers
+ * @param ext Extension header following headers, or NULL
+ * @param ext_len Length of ext
+ * @param payload_offset Offset of the fragment payload in packet
+ * @param payload_len Length of the fragment payload
+ * @return STATUS_SUCCESS or ERROR_PACKET_OPERATION_FAILED
+ */
+static status_t frag_tx_add(ip_frag_tx_t *tx, const packet_buffer_t *packet, const void *headers,
+                            uint16_t headers_len, const void *ext, uint16_t ext_len,
+                            uint32_t payload_offset, uint32_t payload_len) {
+    packet_buffer_t *frag_packet = packet_segment_alloc();
+    packet_buffer_t *payload = packet_buffer_slice(packet, payload_offset, payload_len);
+
+    if (!frag_packet || !payload ||
+        (tx->rewrite && packet_append_data(frag_packet, tx->rewrite->bytes, tx->rewrite->len) != STATUS_SUCCESS) ||
+        packet_append_data(frag_packet, (const uint8_t *)headers, headers_len) != STATUS_SUCCESS ||
+        (ext && packet_append_data(frag_packet, (const uint8_t *)ext, ext_len) != STATUS_SUCCESS)) {
+        if (frag_packet) {
+            packet_destroy(frag_packet);
+        }
+        if (payload) {
+            packet_destroy(payload);
         }
+        return ERROR_PACKET_OPERATION_FAILED;
     }
+    frag_packet->metadata = packet->metadata;
+    packet_invalidate_parse(frag_packet);
+    packet_chain_append(frag_packet, payload);
 
-    if (complete && entry->total_length > 0) {
-        // All fragments received, reassemble the packet
+    tx->pkts[tx->count++] = frag_packet;
+    if (tx->count == PACKET_BURST_MAX) {
+        frag_tx_flush(tx);
+    }
+    return STATUS_SUCCESS;
+}
 
-        // Allocate memory for the reassembled packet if not already done
-        if (!entry->reassembled_data) {
-            entry->reassembled_data = (uint8_t *)malloc(entry->total_length);
-            if (!entry->reassembled_data) {
-                LOG_ERROR( LOG_CATEGORY_L3, "Failed to allocate memory for reassembled IPv6 packet");
-                return ERROR_MEMORY_ALLOCATION_FAILED;
+/**
+ * @brief Send or hold the fragments built so far
+ *
+ * @param tx Fragments of the datagram
+ */
+static void frag_tx_flush(ip_frag_tx_t *tx) {
+    uint32_t done = 0;
+
+    if (tx->rewrite) {
+        // One ring operation for the whole burst; the ring owns what it accepted
+        done = hw_sim_tx_enqueue_burst(tx->rewrite->port_index, tx->pkts, tx->count);
+        for (uint32_t i = done; i < tx->count; i++) {
+            packet_destroy(tx->pkts[i]);
+        }
+    } else {
+        // The neighbor keeps its own reference to each held fragment
+        for (uint32_t i = 0; i < tx->count; i++) {
+            status_t err = tx->version == IP_VERSION_6 ?
+                nd_queue_packet(nd_table_get_instance(), &tx->next_hop6, tx->egress_port, tx->pkts[i]) :
+                arp_queue_packet(arp_table_get_instance(), &tx->next_hop, tx->egress_port, tx->pkts[i]);
+            if (err == ARP_STATUS_PENDING) {
+                done++;
             }
+            packet_destroy(tx->pkts[i]);
         }
+    }
 
-        // Copy the fragments to the reassembled packet
-        ipv6_header_t *header = (ipv6_header_t *)entry->reassembled_data;
-
-        // Set up basic header fields
-        //header->version_traffic_flow = htonl(IP_VERSION_6 << 28); // Version in the top 4 bits
-        header->version_class_flow = htonl(IP_VERSION_6 << 28); // Version in the top 4 bits
-        header->payload_length = htons(entry->total_length - IPV6_HEADER_LEN);
-        header->next_header = entry->next_header;
-        header->hop_limit = IPV6_HOP_LIMIT_DEFAULT;
-        memcpy(&header->src_addr, &entry->src_addr, sizeof(ipv6_addr_t));
-        memcpy(&header->dst_addr, &entry->dst_addr, sizeof(ipv6_addr_t));
+    tx->sent += done;
+    tx->count = 0;
+}
 
-        // Copy the reassembled data to the output packet
-        packet_reset(*reassembled);
-        if (packet_append_data(*reassembled, entry->reassembled_data, entry->total_length) != STATUS_SUCCESS) {
-            LOG_ERROR( LOG_CATEGORY_L3, "Failed to append reassembled IPv6 data to packet");
-            return ERROR_PACKET_OPERATION_FAILED;
-        }
+/**
+ * @brief Drop the fragments built so far
+ *
+ * @param tx Fragments of the datagram
+ */
+static void frag_tx_discard(ip_frag_tx_t *tx) {
+    for (uint32_t i = 0; i < tx->count; i++) {
+        packet_destroy(tx->pkts[i]);
+    }
+    tx->count = 0;
+}
 
-        // Update statistics
-        g_ip_stats.reassembled_packets++;
+/**
+ * @brief Fragment a datagram for the egress MTU and send the fragments
+ *
+ * @param packet Datagram with the L3 header at offset 0
+ * @param mtu MTU of the egress port
+ * @param tx Next hop of the datagram, with no fragments yet
+ * @return STATUS_SUCCESS if fragments left, ERROR_PENDING_RESOLUTION if
+ *         they are held for the next hop, or an error code
+ */
+static status_t forward_fragments(packet_buffer_t *packet, uint16_t mtu, ip_frag_tx_t *tx) {
+    status_t err = tx->version == IP_VERSION_6 ? fragment_ipv6_packet(packet, mtu, tx) :
+                                                 fragment_ipv4_packet(packet, mtu, tx);
+    if (err != STATUS_SUCCESS) {
+        frag_tx_discard(tx);
+        LOG_ERROR(LOG_CATEGORY_L3, "IPv%u fragmentation failed, error: %d", tx->version, err);
+        ip_count_drop(packet, PACKET_DROP_FRAGMENT);
+        return err;
+    }
+    frag_tx_flush(tx);
 
-        LOG_DEBUG(LOG_CATEGORY_L3, "Successfully reassembled IPv6 packet (ID: %u)", entry->ident);
-        return STATUS_SUCCESS;
+    if (tx->sent == 0) {
+        ip_count_drop(packet, tx->rewrite ? PACKET_DROP_TX_ERROR : PACKET_DROP_NEIGHBOR);
+        return tx->rewrite ? ERROR_PACKET_OPERATION_FAILED : ARP_STATUS_QUEUE_FULL;
     }
 
-    // Reassembly still in progress
-    return ERROR_REASSEMBLY_IN_PROGRESS;
+    g_ip_stats.fragmented_packets++;
+    LOG_DEBUG(LOG_CATEGORY_L3, "IPv%u packet fragmented for MTU %u, %u fragments %s",
+              tx->version, mtu, tx->sent, tx->rewrite ? "sent" : "held for resolution");
+    return tx->rewrite ? STATUS_SUCCESS : ERROR_PENDING_RESOLUTION;
 }
 
 /**
  * @brief Fragment an IPv4 packet
  *
- * Splits an IPv4 packet into multiple fragments to fit the MTU.
+ * Splits an IPv4 packet into multiple fragments to fit the MTU. Each
+ * fragment is a header segment followed by a zero-copy slice of the
+ * original payload.
  *
  * @param packet The packet to fragment
  * @param mtu Maximum Transmission Unit of the egress interface
@@ -1164,19 +2402,30 @@ static status_t reassemble_ipv6_fragments(ipv6_frag_entry_t *entry, packet_t **r
  * @return STATUS_SUCCESS if fragmentation is successful
  *         Other error code if fragmentation fails
  */
-static status_t fragment_ipv4_packet(packet_buffer_t *packet, uint16_t mtu, port_id_t egress_port) {
-    ipv4_header_t header;
+static status_t fragment_ipv4_packet(packet_buffer_t *packet, uint16_t mtu, ip_frag_tx_t *tx) {
+    uint8_t header_buf[IPV4_HEADER_MAX_LEN];
+    ipv4_header_t *header = (ipv4_header_t *)header_buf;
     uint16_t offset = 0;
     status_t err;
 
-    // Read the IPv4 header
-    if (packet_peek_data(packet, offset, &header, sizeof(ipv4_header_t)) != STATUS_SUCCESS) {
+    // Read the IPv4 header, options included
+    if (packet_peek_data(packet, offset, header_buf, IPV4_HEADER_MIN_LEN) != STATUS_SUCCESS) {
         LOG_ERROR( LOG_CATEGORY_L3, "Failed to read IPv4 header for fragmentation");
         return ERROR_PACKET_OPERATION_FAILED;
     }
 
-    uint8_t header_len = (header.version_ihl & 0x0F) * 4;
-    uint16_t total_length = ntohs(header.total_length);
+    uint8_t header_len = (header->version_ihl & 0x0F) * 4;
+    if (header_len < IPV4_HEADER_MIN_LEN ||
+        packet_peek_data(packet, offset, header_buf, header_len) != STATUS_SUCCESS) {
+        LOG_ERROR( LOG_CATEGORY_L3, "Failed to read IPv4 header for fragmentation");
+        return ERROR_PACKET_OPERATION_FAILED;
+    }
+
+    uint16_t total_length = ntohs(header->total_length);
+    if (total_length <= header_len || total_length > packet_chain_length(packet) || mtu < header_len + IP_FRAGMENT_UNIT) {
+        return ERROR_CANNOT_FRAGMENT;
+    }
+
     uint16_t data_len = total_length - header_len;
     uint16_t max_payload = (mtu - header_len) & ~7; // Ensure it's a multiple of 8
     uint16_t num_fragments = (data_len + max_payload - 1) / max_payload;
@@ -1184,71 +2433,41 @@ static status_t fragment_ipv4_packet(packet_buffer_t *packet, uint16_t mtu, port
     LOG_DEBUG(LOG_CATEGORY_L3, "Fragmenting IPv4 packet: total_length=%u, header_len=%u, data_len=%u, max_payload=%u, num_fragments=%u",
               total_length, header_len, data_len, max_payload, num_fragments);
 
-    // Extract the packet data
-    uint8_t *packet_data = (uint8_t *)malloc(total_length);
-    if (!packet_data) {
-        LOG_ERROR( LOG_CATEGORY_L3, "Failed to allocate memory for packet data");
-        return ERROR_MEMORY_ALLOCATION_FAILED;
-    }
-
-    if (packet_copy_data(packet, 0, packet_data, total_length) != STATUS_SUCCESS) {
-        LOG_ERROR( LOG_CATEGORY_L3, "Failed to copy packet data for fragmentation");
-        free(packet_data);
-        return ERROR_PACKET_OPERATION_FAILED;
-    }
-
     uint16_t frag_offset = 0;
-    uint16_t data_offset = header_len;
-    uint16_t flags_frag_offset = ntohs(header.flags_fragment_offset);
+    uint16_t flags_frag_offset = ntohs(header->flags_fragment_offset);
     uint16_t orig_flags = flags_frag_offset & ~IP_FRAG_OFFSET_MASK;
+    uint16_t orig_offset = flags_frag_offset & IP_FRAG_OFFSET_MASK;
+
+    // Fragments inherit the offload flags; their checksums go to the NIC if it can
+    bool csum_offload = (hw_sim_get_port_offloads(tx->egress_port) & DRIVER_FLAG_TX_CSUM) != 0;
+    if (csum_offload) {
+        packet->metadata.offload |= PACKET_OFFLOAD_IP_CSUM;
+    } else {
+        packet->metadata.offload &= ~PACKET_OFFLOAD_IP_CSUM;
+    }
 
     for (uint16_t i = 0; i < num_fragments; i++) {
         uint16_t payload_size = (i == num_fragments - 1) ?
                                (data_len - frag_offset) : max_payload;
-        uint16_t frag_total_len = header_len + payload_size;
-
-        // Create a new packet for the fragment
-        //packet_t frag_packet;
-        packet_buffer_t *frag_packet = NULL;
-        //if (packet_create(&frag_packet) != STATUS_SUCCESS) {
-        if (packet_create(&frag_packet) != STATUS_SUCCESS) {
-            LOG_ERROR( LOG_CATEGORY_L3, "Failed to create fragment packet");
-            free(packet_data);
-            return ERROR_PACKET_OPERATION_FAILED;
-        }
 
         // Update the header for this fragment
-        ipv4_header_t frag_header = header;
-        frag_header.total_length = htons(frag_total_len);
+        header->total_length = htons(header_len + payload_size);
 
         // Set fragmentation flags and offset
-        uint16_t new_offset = (frag_offset / 8); // Fragment offset in 8-byte units
+        uint16_t new_offset = orig_offset + (frag_offset / 8); // Fragment offset in 8-byte units
         uint16_t new_flags = (i == num_fragments - 1) ? orig_flags : (orig_flags | IP_FLAG_MF);
-        frag_header.flags_fragment_offset = htons(new_flags | new_offset);
+        header->flags_fragment_offset = htons(new_flags | new_offset);
 
         // Recalculate checksum
-        frag_header.header_checksum = 0;
-        frag_header.header_checksum = calculate_ipv4_checksum(&frag_header, header_len);
-
-        // Append the header and payload to the fragment packet
-        if (packet_append_data(frag_packet, (uint8_t *) &frag_header, header_len) != STATUS_SUCCESS ||
-            packet_append_data(frag_packet, (uint8_t *) packet_data + data_offset + frag_offset, payload_size) != STATUS_SUCCESS) {
-            LOG_ERROR( LOG_CATEGORY_L3, "Failed to append data to fragment packet");
-            //packet_destroy(&frag_packet);
-            packet_destroy(frag_packet);
-            free(packet_data);
-            return ERROR_PACKET_OPERATION_FAILED;
+        header->header_checksum = 0;
+        if (!csum_offload) {
+            header->header_checksum = calculate_ipv4_checksum(header, header_len);
         }
 
-        // Forward the fragment
-        // Note: We're bypassing the regular forwarding logic since we've already decremented TTL, etc.
-        //err = port_send_packet(egress_port, &frag_packet);
-        err = port_send_packet(egress_port, frag_packet);
-        packet_destroy(frag_packet);
-
+        // The fragment is a fresh header segment followed by a slice of the payload
+        err = frag_tx_add(tx, packet, header_buf, header_len, NULL, 0, header_len + frag_offset, payload_size);
         if (err != STATUS_SUCCESS) {
-            LOG_ERROR( LOG_CATEGORY_L3, "Failed to send IPv4 fragment %u/%u, error: %d", i+1, num_fragments, err);
-            free(packet_data);
+            LOG_ERROR( LOG_CATEGORY_L3, "Failed to build IPv4 fragment %u/%u", i+1, num_fragments);
             return err;
         }
 
@@ -1256,14 +2475,15 @@ static status_t fragment_ipv4_packet(packet_buffer_t *packet, uint16_t mtu, port
         frag_offset += payload_size;
     }
 
-    free(packet_data);
     return STATUS_SUCCESS;
 }
 
 /**
  * @brief Fragment an IPv6 packet
  *
- * Splits an IPv6 packet into multiple fragments to fit the MTU.
+ * Splits an IPv6 packet into multiple fragments to fit the MTU. Each
+ * fragment is a segment holding the IPv6 and Fragment headers followed
+ * by a zero-copy slice of the original payload.
  *
  * @param packet The packet to fragment
  * @param mtu Maximum Transmission Unit of the egress interface
@@ -1271,7 +2491,7 @@ static status_t fragment_ipv4_packet(packet_buffer_t *packet, uint16_t mtu, port
  * @return STATUS_SUCCESS if fragmentation is successful
  *         Other error code if fragmentation fails
  */
-static status_t fragment_ipv6_packet(packet_buffer_t *packet, uint16_t mtu, port_id_t egress_port) {
+static status_t fragment_ipv6_packet(packet_buffer_t *packet, uint16_t mtu, ip_frag_tx_t *tx) {
     ipv6_header_t header;
     uint16_t offset = 0;
     status_t err;
@@ -1283,36 +2503,27 @@ static status_t fragment_ipv6_packet(packet_buffer_t *packet, uint16_t mtu, port
     }
 
     uint16_t payload_length = ntohs(header.payload_length);
-    uint16_t total_length = payload_length + IPV6_HEADER_LEN;
+    uint32_t total_length = payload_length + IPV6_HEADER_LEN;
     uint16_t data_len = payload_length;
 
     // IPv6 requires Fragment header (8 bytes)
-    uint16_t fragment_header_size = 8;
+    uint16_t fragment_header_size = IPV6_FRAG_HEADER_LEN;
+    if (data_len == 0 || total_length > packet_chain_length(packet) ||
+        mtu < IPV6_HEADER_LEN + fragment_header_size + IP_FRAGMENT_UNIT) {
+        return ERROR_CANNOT_FRAGMENT;
+    }
+
     uint16_t max_payload = (mtu - IPV6_HEADER_LEN - fragment_header_size) & ~7; // Ensure it's a multiple of 8
     uint16_t num_fragments = (data_len + max_payload - 1) / max_payload;
 
     LOG_DEBUG(LOG_CATEGORY_L3, "Fragmenting IPv6 packet: total_length=%u, data_len=%u, max_payload=%u, num_fragments=%u",
               total_length, data_len, max_payload, num_fragments);
 
-    // Extract the packet data
-    uint8_t *packet_data = (uint8_t *)malloc(total_length);
-    if (!packet_data) {
-        LOG_ERROR( LOG_CATEGORY_L3, "Failed to allocate memory for packet data");
-        return ERROR_MEMORY_ALLOCATION_FAILED;
-    }
-
-    if (packet_copy_data(packet, 0, packet_data, total_length) != STATUS_SUCCESS) {
-        LOG_ERROR( LOG_CATEGORY_L3, "Failed to copy packet data for fragmentation");
-        free(packet_data);
-        return ERROR_PACKET_OPERATION_FAILED;
-    }
-
     // Generate a fragment identification
     static uint32_t frag_id = 0;
     uint32_t id = ++frag_id;
 
     uint16_t frag_offset = 0;
-    uint16_t data_offset = IPV6_HEADER_LEN;
     uint8_t next_header = header.next_header;
 
     for (uint16_t i = 0; i < num_fragments; i++) {
@@ -1320,15 +2531,6 @@ static status_t fragment_ipv6_packet(packet_buffer_t *packet, uint16_t mtu, port
                                (data_len - frag_offset) : max_payload;
         uint16_t frag_payload_len = payload_size + fragment_header_size;
 
-        // Create a new packet for the fragment
-        //packet_buffer_t frag_packet;
-        packet_buffer_t *frag_packet = NULL;
-        if (packet_create(&frag_packet) != STATUS_SUCCESS) {
-            LOG_ERROR( LOG_CATEGORY_L3, "Failed to create fragment packet");
-            free(packet_data);
-            return ERROR_PACKET_OPERATION_FAILED;
-        }
-
         // Update the header for this fragment
         ipv6_header_t frag_header = header;
         frag_header.payload_length = htons(frag_payload_len);
@@ -1342,44 +2544,306 @@ static status_t fragment_ipv6_packet(packet_buffer_t *packet, uint16_t mtu, port
             uint32_t identification;
         } frag_ext_header;
 
-        frag_ext_header.next_header = next_header;
-        frag_ext_header.reserved = 0;
+        frag_ext_header.next_header = next_header;
+        frag_ext_header.reserved = 0;
+
+        // Set fragmentation flags and offset
+        uint16_t new_offset = (frag_offset / 8); // Fragment offset in 8-byte units
+        uint16_t more_flag = (i == num_fragments - 1) ? 0 : 1;
+        frag_ext_header.offset_flags = htons((new_offset << 3) | more_flag);
+        frag_ext_header.identification = htonl(id);
+
+        // The fragment is a fresh header segment followed by a slice of the payload
+        err = frag_tx_add(tx, packet, &frag_header, IPV6_HEADER_LEN, &frag_ext_header, fragment_header_size,
+                          IPV6_HEADER_LEN + frag_offset, payload_size);
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR( LOG_CATEGORY_L3, "Failed to build IPv6 fragment %u/%u", i+1, num_fragments);
+            return err;
+        }
+
+        // Update the fragment offset for the next fragment
+        frag_offset += payload_size;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+
+
+/* --- FLOW CACHE ------------------------------------------------------------*/
+
+/*
+ * Each forwarding worker keeps a direct-mapped cache of the flows it
+ * routed: 5-tuple, ingress port and VLAN map to the egress port, a copy of
+ * the next hop's L2 rewrite and the QoS class the packet left with. A
+ * packet of a cached flow gets its header checked, TTL or hop limit
+ * decremented and the rewrite pushed, and leaves without a route lookup
+ * or a neighbor lookup. Entries are not invalidated one by one: each
+ * records the FIB, neighbor and MAC table generations it was made at, and
+ * any change to one of those tables retires every entry at once. Packets
+ * the slow path treats specially (fragments, IPv4 options, IPv6 extension
+ * headers, Neighbor Discovery, expiring TTL, oversize) always take it.
+ */
+
+/**
+ * @brief Get the calling thread's flow cache, creating it on first use
+ *
+ * @return Cache, NULL if none could be created
+ */
+static ip_flow_cache_t *flow_cache_get(void) {
+    uint32_t epoch = __atomic_load_n(&g_flow_cache_epoch, __ATOMIC_ACQUIRE);
+    ip_flow_cache_t *cache = NULL;
+
+    if (t_flow_cache && t_flow_cache_epoch == epoch) {
+        return t_flow_cache;
+    }
+
+    if ((cache = mem_aligned_alloc(MEM_TAG_IP, IP_FLOW_CACHE_ALIGN, sizeof(ip_flow_cache_t))) == NULL) {
+        return NULL;
+    }
+    memset(cache, 0, sizeof(*cache));
+
+    spinlock_acquire(&g_flow_cache_lock);
+    if (g_flow_cache_count >= IP_FLOW_CACHE_MAX_WORKERS) {
+        spinlock_release(&g_flow_cache_lock);
+        mem_free(MEM_TAG_IP, cache);
+        LOG_WARNING(LOG_CATEGORY_L3, "No flow cache left for this thread");
+        return NULL;
+    }
+    g_flow_caches[g_flow_cache_count++] = cache;
+    spinlock_release(&g_flow_cache_lock);
+
+    t_flow_cache = cache;
+    t_flow_cache_epoch = epoch;
+    return cache;
+}
+
+/**
+ * @brief Free the flow cache of every worker
+ *
+ * No packet may be in flight. Threads notice the new epoch and build a
+ * fresh cache on their next packet.
+ */
+static void flow_cache_free_all(void) {
+    spinlock_acquire(&g_flow_cache_lock);
+    for (uint32_t i = 0; i < g_flow_cache_count; i++) {
+        mem_free(MEM_TAG_IP, g_flow_caches[i]);
+        g_flow_caches[i] = NULL;
+    }
+    g_flow_cache_count = 0;
+    __atomic_store_n(&g_flow_cache_epoch, g_flow_cache_epoch + 1, __ATOMIC_RELEASE);
+    spinlock_release(&g_flow_cache_lock);
+}
+
+/**
+ * @brief Get the cache slot of a flow
+ *
+ * @param key Flow key
+ * @return Slot index
+ */
+static inline uint32_t flow_cache_index(const ip_flow_key_t *key) {
+    const uint8_t *bytes = (const uint8_t *)key;
+    uint32_t hash = 0;
+    uint32_t word;
+
+    for (size_t i = 0; i < sizeof(*key); i += sizeof(word)) {
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 0x9E3779B1U;
+    }
+
+    return hash >> (32 - IP_FLOW_CACHE_BITS);
+}
+
+/**
+ * @brief Build the flow key of a packet
+ *
+ * Only packets whose header cache describes a plain IP header at offset
+ * are keyed; the rest always take the slow path.
+ *
+ * @param packet Packet to key
+ * @param offset Offset of its IP header
+ * @param version IP version
+ * @param[out] key Flow key
+ * @return true if the packet may use the flow cache
+ */
+static bool flow_key_build(const packet_buffer_t *packet, uint16_t offset, uint8_t version, ip_flow_key_t *key) {
+    uint16_t ports[2] = { 0, 0 };
+
+    if (!packet_parsed_has(packet, PACKET_PARSED_L3 | PACKET_PARSED_L4) ||
+        packet_l3_offset(packet) != offset ||
+        packet_has_proto(packet, PACKET_PROTO_IP_OPTIONS | PACKET_PROTO_IP_FRAG)) {
+        return false;
+    }
+
+    memset(key, 0, sizeof(*key));
+    if (version == IP_VERSION_4) {
+        const ipv4_header_t *header = (const ipv4_header_t *)(packet->data + offset);
+
+        if (offset + sizeof(ipv4_header_t) > packet->size) {
+            return false;
+        }
+        memcpy(key->src, &header->src_addr, sizeof(ipv4_addr_t));
+        memcpy(key->dst, &header->dst_addr, sizeof(ipv4_addr_t));
+        key->protocol = header->protocol;
+    } else if (version == IP_VERSION_6) {
+        const ipv6_header_t *header = (const ipv6_header_t *)(packet->data + offset);
+
+        if (offset + sizeof(ipv6_header_t) > packet->size) {
+            return false;
+        }
+        /* Neighbor Discovery is answered by the slow path */
+        if (header->next_header == IP_PROTO_ICMPV6 && header->hop_limit == IPV6_HOP_LIMIT_ND) {
+            return false;
+        }
+        memcpy(key->src, &header->src_addr, sizeof(ipv6_addr_t));
+        memcpy(key->dst, &header->dst_addr, sizeof(ipv6_addr_t));
+        key->protocol = header->next_header;
+    } else {
+        return false;
+    }
+
+    if (packet_has_proto(packet, PACKET_PROTO_TCP | PACKET_PROTO_UDP)) {
+        if (packet_l4_offset(packet) + sizeof(ports) > packet->size) {
+            return false;
+        }
+        memcpy(ports, packet->data + packet_l4_offset(packet), sizeof(ports));
+    }
+    key->src_port = ports[0];
+    key->dst_port = ports[1];
+    key->in_port = packet->metadata.port;
+    key->vlan = packet->metadata.vlan;
+    key->version = version;
+    return true;
+}
+
+/**
+ * @brief Forward a packet of an established flow from the flow cache
+ *
+ * On a miss the flow is remembered, with the table generations taken
+ * before routing starts, so that forward_ip_packet() can install the
+ * decision the slow path makes for it.
+ *
+ * @param packet Packet to forward
+ * @param offset Offset of its IP header
+ * @param version IP version
+ * @param[out] status Result of forwarding, set only if the packet was handled
+ * @return true if the packet was handled, false if it takes the slow path
+ */
+static bool flow_cache_forward(packet_buffer_t *packet, uint16_t offset, uint8_t version, status_t *status) {
+    ip_flow_cache_t *cache;
+    ip_flow_entry_t *slot;
+    ip_flow_key_t key;
+    uint32_t fib_generation, arp_generation, mac_generation, pbr_generation;
+    uint32_t length;
+    uint8_t *l2_header;
+    status_t err;
+
+    t_flow_pending.packet = NULL;
+    if (!__atomic_load_n(&g_flow_cache_enabled, __ATOMIC_RELAXED) ||
+        !flow_key_build(packet, offset, version, &key)) {
+        return false;
+    }
+
+    cache = flow_cache_get();
+    if (!cache) {
+        return false;
+    }
+
+    /* Loaded before the slow path runs, so a change made meanwhile retires what it installs */
+    fib_generation = routing_table_get_generation();
+    arp_generation = arp_get_generation();
+    mac_generation = mac_table_get_generation();
+    pbr_generation = acl_pbr_get_generation();
+    slot = &cache->slots[flow_cache_index(&key)];
+
+    if (slot->fib_generation != fib_generation || slot->arp_generation != arp_generation ||
+        slot->mac_generation != mac_generation || slot->pbr_generation != pbr_generation ||
+        memcmp(&slot->key, &key, sizeof(key)) != 0) {
+        goto miss;
+    }
+
+    /* The per-packet checks of the slow path still apply; a packet failing one takes it */
+    if (version == IP_VERSION_4) {
+        ipv4_header_t *header = (ipv4_header_t *)(packet->data + offset);
 
-        // Set fragmentation flags and offset
-        uint16_t new_offset = (frag_offset / 8); // Fragment offset in 8-byte units
-        uint16_t more_flag = (i == num_fragments - 1) ? 0 : 1;
-        frag_ext_header.offset_flags = htons((new_offset << 3) | more_flag);
-        frag_ext_header.identification = htonl(id);
+        if (validate_ipv4_header(header, ip_available_length(packet, offset),
+                                 ipv4_needs_checksum(packet)) != STATUS_SUCCESS ||
+            header->ttl <= TTL_THRESHOLD) {
+            goto miss;
+        }
+        length = ntohs(header->total_length);
+        if (length > g_port_mtu_table[slot->egress_port] ||
+            packet_push_header(packet, slot->rewrite.len, &l2_header) != STATUS_SUCCESS) {
+            goto miss;
+        }
+        ipv4_forward_ttl(packet, header, hw_sim_get_port_offloads(slot->egress_port));
+        g_ip_stats.ipv4_packets++;
+    } else {
+        ipv6_header_t *header = (ipv6_header_t *)(packet->data + offset);
 
-        // Append headers and payload to the fragment packet
-        if (packet_append_data(frag_packet, (uint8_t *) &frag_header, IPV6_HEADER_LEN) != STATUS_SUCCESS ||
-            packet_append_data(frag_packet, (uint8_t *) &frag_ext_header, fragment_header_size) != STATUS_SUCCESS ||
-            packet_append_data(frag_packet, (uint8_t *) packet_data + data_offset + frag_offset, payload_size) != STATUS_SUCCESS) {
-            LOG_ERROR( LOG_CATEGORY_L3, "Failed to append data to fragment packet");
-            //packet_destroy(&frag_packet);
-            packet_destroy(frag_packet);
-            free(packet_data);
-            return ERROR_PACKET_OPERATION_FAILED;
+        if (validate_ipv6_header(header, ip_available_length(packet, offset)) != STATUS_SUCCESS ||
+            header->hop_limit <= IPV6_HOP_LIMIT_THRESHOLD) {
+            goto miss;
+        }
+        length = (uint32_t)ntohs(header->payload_length) + IPV6_HEADER_LEN;
+        if (length > g_port_mtu_table[slot->egress_port] ||
+            packet_push_header(packet, slot->rewrite.len, &l2_header) != STATUS_SUCCESS) {
+            goto miss;
         }
+        header->hop_limit--;
+        g_ip_stats.ipv6_packets++;
+    }
 
-        // Forward the fragment
-        //err = port_send_packet(egress_port, &frag_packet);
-        err = port_send_packet(egress_port, frag_packet);
-        //packet_destroy(&frag_packet);
-        packet_destroy(frag_packet);
+    memcpy(l2_header, slot->rewrite.bytes, slot->rewrite.len);
+    packet->metadata.priority = slot->qos_class;
+    g_ip_stats.flow_cache_hits++;
 
-        if (err != STATUS_SUCCESS) {
-            LOG_ERROR( LOG_CATEGORY_L3, "Failed to send IPv6 fragment %u/%u, error: %d", i+1, num_fragments, err);
-            free(packet_data);
-            return err;
-        }
+    err = port_send_packet(slot->egress_port, packet);
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to send packet on port %u, error: %d", slot->egress_port, err);
+        ip_count_drop(packet, PACKET_DROP_TX_ERROR);
+        *status = err;
+        return true;
+    }
 
-        // Update the fragment offset for the next fragment
-        frag_offset += payload_size;
+    g_ip_stats.forwarded_packets++;
+    *status = STATUS_SUCCESS;
+    return true;
+
+miss:
+    g_ip_stats.flow_cache_misses++;
+    t_flow_pending.packet = packet;
+    t_flow_pending.slot = slot;
+    t_flow_pending.entry.key = key;
+    t_flow_pending.entry.fib_generation = fib_generation;
+    t_flow_pending.entry.arp_generation = arp_generation;
+    t_flow_pending.entry.mac_generation = mac_generation;
+    t_flow_pending.entry.pbr_generation = pbr_generation;
+    return false;
+}
+
+/**
+ * @brief Install the forwarding decision made for a packet of a missed flow
+ *
+ * Called by forward_ip_packet() inside the RCU read section the rewrite
+ * was found in; does nothing for packets that did not miss the cache.
+ *
+ * @param packet Packet being forwarded
+ * @param egress_port Port it leaves on
+ * @param rewrite L2 rewrite of its next hop
+ */
+static void flow_cache_install(const packet_buffer_t *packet, port_id_t egress_port, const arp_rewrite_t *rewrite) {
+    ip_flow_entry_t *slot = t_flow_pending.slot;
+
+    if (t_flow_pending.packet != packet) {
+        return;
     }
+    t_flow_pending.packet = NULL;
 
-    free(packet_data);
-    return STATUS_SUCCESS;
+    *slot = t_flow_pending.entry;
+    slot->rewrite = *rewrite;
+    slot->egress_port = egress_port;
+    slot->qos_class = packet->metadata.priority;
 }
 
 
@@ -1410,7 +2874,7 @@ static status_t process_ipv4_packet(packet_buffer_t *packet, uint16_t *offset) {
     if (*offset + sizeof(ipv4_header_t) > packet->size) {
         LOG_ERROR( LOG_CATEGORY_L3, "Packet too short for IPv4 header");
         g_ip_stats.header_errors++;
-        g_ip_stats.dropped_packets++;
+        ip_count_drop(packet, PACKET_DROP_IP_HEADER);
         return ERROR_PACKET_TOO_SHORT;
     }
     
@@ -1429,11 +2893,12 @@ static status_t process_ipv4_packet(packet_buffer_t *packet, uint16_t *offset) {
     //}
     
     /* Validate header */
-    status = validate_ipv4_header(header, packet->size - *offset);
+    status = validate_ipv4_header(header, ip_available_length(packet, *offset),
+                                  ipv4_needs_checksum(packet));
     if (status != STATUS_SUCCESS) {
         LOG_ERROR( LOG_CATEGORY_L3, "IPv4 header validation failed: error=%d", status);
         g_ip_stats.header_errors++;
-        g_ip_stats.dropped_packets++;
+        ip_count_drop(packet, PACKET_DROP_IP_HEADER);
         return status;
     }
     
@@ -1442,7 +2907,7 @@ static status_t process_ipv4_packet(packet_buffer_t *packet, uint16_t *offset) {
         status = process_ipv4_options(header, packet);
         if (status != STATUS_SUCCESS) {
             LOG_ERROR( LOG_CATEGORY_L3, "IPv4 options processing failed: error=%d", status);
-            g_ip_stats.dropped_packets++;
+            ip_count_drop(packet, PACKET_DROP_IP_HEADER);
             return status;
         }
     }
@@ -1452,82 +2917,76 @@ static status_t process_ipv4_packet(packet_buffer_t *packet, uint16_t *offset) {
     is_fragment = (frag_info & (IP_FLAG_MF | IP_FRAG_OFFSET_MASK)) != 0;
     
     if (is_fragment) {
-        /* Handle IP fragmentation */
+        /* Handle IP fragmentation; entries that timed out go first */
+        cleanup_stale_fragments();
         ipv4_frag_entry_t *frag_entry = find_ipv4_frag_entry(header);
         
         if (!frag_entry) {
-            /* Create new fragment entry */
-            frag_entry = (ipv4_frag_entry_t *)malloc(sizeof(ipv4_frag_entry_t));
+            frag_entry = create_ipv4_frag_entry(header);
             if (!frag_entry) {
                 LOG_ERROR( LOG_CATEGORY_L3, "Failed to allocate IPv4 fragment entry");
-                g_ip_stats.dropped_packets++;
-                return ERROR_OUT_OF_MEMORY;
+                ip_count_drop(packet, PACKET_DROP_FRAGMENT);
+                return STATUS_RESOURCE_EXCEEDED;
             }
-            
-            /* Initialize fragment entry */
-            memset(frag_entry, 0, sizeof(ipv4_frag_entry_t));
-            frag_entry->src_addr = header->src_addr;
-            frag_entry->dst_addr = header->dst_addr;
-            frag_entry->ident = ntohs(header->id);
-            frag_entry->protocol = header->protocol;
-            frag_entry->arrival_time = get_timestamp_ms();
-            frag_entry->next = g_ipv4_frag_table;
-            g_ipv4_frag_table = frag_entry;
         }
         
-        /* Process fragment */
-        uint16_t frag_offset = (frag_info & IP_FRAG_OFFSET_MASK) * IP_FRAGMENT_UNIT;
-        uint16_t data_len = ntohs(header->total_length) - header_len;
-        
-        /* Update total length if this is the last fragment */
-        if ((frag_info & IP_FLAG_MF) == 0) {
-            frag_entry->total_length = frag_offset + data_len;
-        }
-        
-        /* Mark fragment as received */
-        if (frag_offset / IP_FRAGMENT_UNIT < MAX_FRAGMENTS) {
-            frag_entry->fragments[frag_offset / IP_FRAGMENT_UNIT] = true;
-            frag_entry->fragments_received++;
+        /* Queue the fragment payload as a slice of this packet */
+        uint32_t frag_offset = (frag_info & IP_FRAG_OFFSET_MASK) * IP_FRAGMENT_UNIT;
+        uint32_t data_len = ntohs(header->total_length) - header_len;
+
+        /* A source over its budget loses the datagram instead of starving others */
+        if (!frag_source_charge(&frag_entry->timer, data_len)) {
+            LOG_DEBUG(LOG_CATEGORY_L3, "IPv4 reassembly memory of source exceeded, dropping datagram");
+            remove_ipv4_frag_entry(frag_entry);
+            ip_count_drop(packet, PACKET_DROP_FRAGMENT);
+            return STATUS_RESOURCE_EXCEEDED;
         }
-        
-        /* Copy fragment data */
-        if (!frag_entry->reassembled_data) {
-            frag_entry->reassembled_data = (uint8_t *)malloc(MAX_PACKET_SIZE);
-            if (!frag_entry->reassembled_data) {
-                LOG_ERROR( LOG_CATEGORY_L3, "Failed to allocate memory for reassembled data");
-                g_ip_stats.dropped_packets++;
-                return ERROR_OUT_OF_MEMORY;
-            }
-            memset(frag_entry->reassembled_data, 0, MAX_PACKET_SIZE);
+
+        status = frag_queue_insert(&frag_entry->queue, packet, *offset, *offset + header_len,
+                                   *offset + header_len, frag_offset, data_len,
+                                   (frag_info & IP_FLAG_MF) == 0);
+        if (status != STATUS_SUCCESS) {
+            LOG_DEBUG(LOG_CATEGORY_L3, "Dropping IPv4 fragment (ID: %u, offset: %u): error=%d",
+                      frag_entry->ident, frag_offset, status);
+            ip_count_drop(packet, PACKET_DROP_FRAGMENT);
+            return status;
         }
         
-        /* Copy fragment data to reassembly buffer */
-        memcpy(frag_entry->reassembled_data + frag_offset, 
-               packet->data + *offset + header_len, 
-               data_len);
-        
         /* Check if we have all fragments */
         packet_t *reassembled = NULL;
         status = reassemble_ipv4_fragments(frag_entry, &reassembled);
         
-        if (status == STATUS_SUCCESS && reassembled) {
-            g_ip_stats.reassembled_packets++;
+        if (status == STATUS_SUCCESS) {
             /* Process the reassembled packet */
-            uint16_t new_offset = 0;
+            uint16_t new_offset = frag_entry->queue.l3_offset;
+            remove_ipv4_frag_entry(frag_entry);
             status = ip_process_packet(reassembled, &new_offset);
             packet_buffer_free(reassembled);
             return status;
-        } else if (status == (status_t)ERROR_IN_PROGRESS) {
+        } else if (status == ERROR_REASSEMBLY_IN_PROGRESS) {
             /* Still waiting for more fragments */
             return STATUS_SUCCESS;
         } else {
             LOG_ERROR( LOG_CATEGORY_L3, "Failed to reassemble IPv4 fragments: error=%d", status);
-            g_ip_stats.dropped_packets++;
+            remove_ipv4_frag_entry(frag_entry);
+            ip_count_drop(packet, PACKET_DROP_FRAGMENT);
             return status;
         }
     }
     
-    /* Check if TTL has expired */
+    /* Check if packet is destined for local system */
+    if (is_local_address(&header->dst_addr, false)) {
+        g_ip_stats.local_delivered++;
+        return deliver_to_local_stack(packet, header->protocol);
+    }
+
+    /* Routed groups are replicated by the multicast FIB; 224.0.0.0/24 never leaves the link */
+    const uint8_t *dst = packet->data + *offset + 16;
+    if ((dst[0] & 0xF0) == 0xE0 && !(dst[0] == 224 && dst[1] == 0 && dst[2] == 0)) {
+        return forward_ipv4_multicast(packet, *offset);
+    }
+
+    /* Check if TTL has expired; only routed packets use up a hop */
     if (header->ttl <= TTL_THRESHOLD) {
         LOG_DEBUG(LOG_CATEGORY_L3, "TTL expired for packet from %d.%d.%d.%d to %d.%d.%d.%d",
                  IPV4_OCTET1(header->src_addr),IPV4_OCTET2( header->src_addr), 
@@ -1535,43 +2994,38 @@ static status_t process_ipv4_packet(packet_buffer_t *packet, uint16_t *offset) {
                  IPV4_OCTET1(header->dst_addr), IPV4_OCTET2(header->dst_addr), 
                  IPV4_OCTET3(header->dst_addr), IPV4_OCTET4(header->dst_addr));
         g_ip_stats.ttl_exceeded++;
-        g_ip_stats.dropped_packets++;
+        ip_count_drop(packet, PACKET_DROP_TTL_EXCEEDED);
         /* Send ICMP Time Exceeded message back to source */
-        /* This would be implemented in a separate ICMP module */
+        icmp_send_error(packet, *offset, ICMP_TYPE_TIME_EXCEEDED, ICMP_CODE_TTL_EXCEEDED, 0);
         return ERROR_TTL_EXPIRED;
     }
     
-    /* Decrement TTL */
-    header->ttl--;
-    
-    /* Recalculate checksum */
-    header->header_checksum = 0;
-    header->header_checksum = calculate_ipv4_checksum(header, header_len);
-    
-    /* Check if packet is destined for local system */
-    if (is_local_address(&header->dst_addr, false)) {
-        g_ip_stats.local_delivered++;
-        return deliver_to_local_stack(packet, header->protocol);
-    }
+    /* Decrement TTL; the egress is not known yet, so the checksum is patched */
+    ipv4_forward_ttl(packet, header, 0);
     
     /* Получаем экземпляр таблицы маршрутизации */
     routing_table = routing_table_get_instance();
     if (!routing_table) {
         LOG_ERROR(LOG_CATEGORY_L3, "Failed to get routing table instance");
-        g_ip_stats.dropped_packets++;
+        ip_count_drop(packet, PACKET_DROP_INTERNAL);
         return ERROR_INTERNAL;
     }
 
-    /* Look up route */
+    /* Look up route; a policy route of the ingress port takes precedence */
     ip_addr_t dest_ip;
     dest_ip.type = IP_TYPE_V4;
     dest_ip.addr.v4 = header->dst_addr;
-    status = routing_table_lookup(routing_table, &dest_ip, IP_TYPE_V4, &route);
+    if (acl_pbr_attached(packet->metadata.port) && policy_route(packet, *offset, false, &route)) {
+        status = STATUS_SUCCESS;
+    } else {
+        status = routing_table_lookup(routing_table, &dest_ip, IP_TYPE_V4, &route);
+    }
     if (status != STATUS_SUCCESS) {
         LOG_ERROR(LOG_CATEGORY_L3, "No route found for %d.%d.%d.%d",
            IPV4_OCTET1(header->dst_addr), IPV4_OCTET2(header->dst_addr),
            IPV4_OCTET3(header->dst_addr), IPV4_OCTET4(header->dst_addr));
-        g_ip_stats.dropped_packets++;
+        ip_count_drop(packet, PACKET_DROP_NO_ROUTE);
+        icmp_send_error(packet, *offset, ICMP_TYPE_DEST_UNREACH, ICMP_CODE_NET_UNREACH, 0);
         return ERROR_NO_ROUTE;
     }
     
@@ -1581,6 +3035,37 @@ static status_t process_ipv4_packet(packet_buffer_t *packet, uint16_t *offset) {
     return forward_ip_packet(packet, &route);
 }
 
+/**
+ * @brief Route a packet by the PBR policy of its ingress port
+ *
+ * @param packet Packet being routed
+ * @param l3_offset Offset of its IP header
+ * @param is_ipv6 Whether the packet is IPv6
+ * @param[out] route Route through the path the policy picked
+ * @return true if the policy redirects the packet, false if the FIB routes it
+ */
+static bool policy_route(const packet_buffer_t *packet, uint16_t l3_offset, bool is_ipv6, route_entry_t *route) {
+    ip_addr_t next_hop;
+    port_id_t egress_port;
+
+    if (acl_pbr_lookup(packet, l3_offset, &next_hop, &egress_port) != STATUS_SUCCESS) {
+        return false;
+    }
+
+    /* An unspecified next hop delivers to the destination, as a connected route */
+    memset(route, 0, sizeof(*route));
+    route->is_ipv6 = is_ipv6;
+    if (is_ipv6) {
+        route->route.ipv6.next_hop = next_hop.addr.v6;
+    } else {
+        route->route.ipv4.gateway = next_hop.addr.v4;
+    }
+    route->egress_port = egress_port;
+    route->interface_index = egress_port;
+    route->active = true;
+    return true;
+}
+
 /**
  * @brief Process an IPv6 packet
  *
@@ -1599,11 +3084,12 @@ static status_t process_ipv6_packet(packet_buffer_t *packet, uint16_t *offset) {
     route_entry_t route;
     routing_table_t *routing_table;
     ipv6_ext_headers_ctx_t ext_headers_ctx;
+    uint16_t l3_offset = *offset;
     
     if (*offset + sizeof(ipv6_header_t) > packet->size) {
         LOG_ERROR( LOG_CATEGORY_L3, "Packet too short for IPv6 header");
         g_ip_stats.header_errors++;
-        g_ip_stats.dropped_packets++;
+        ip_count_drop(packet, PACKET_DROP_IP_HEADER);
         return ERROR_PACKET_TOO_SHORT;
     }
     
@@ -1612,38 +3098,43 @@ static status_t process_ipv6_packet(packet_buffer_t *packet, uint16_t *offset) {
     (void)payload_len;   /* Unused */
     
     /* Validate header */
-    status = validate_ipv6_header(header, packet->size - *offset);
+    status = validate_ipv6_header(header, ip_available_length(packet, *offset));
     if (status != STATUS_SUCCESS) {
         LOG_ERROR( LOG_CATEGORY_L3, "IPv6 header validation failed: error=%d", status);
         g_ip_stats.header_errors++;
-        g_ip_stats.dropped_packets++;
+        ip_count_drop(packet, PACKET_DROP_IP_HEADER);
         return status;
     }
     
-    /* Check if Hop Limit has expired */
-    if (header->hop_limit <= IPV6_HOP_LIMIT_THRESHOLD) {
-        LOG_DEBUG(LOG_CATEGORY_L3, "Hop Limit expired for IPv6 packet");
-        g_ip_stats.ttl_exceeded++;
-        g_ip_stats.dropped_packets++;
-        /* Send ICMPv6 Time Exceeded message back to source */
-        /* This would be implemented in a separate ICMPv6 module */
-        return ERROR_TTL_EXPIRED;
+    /* Neighbor Discovery is link-local and always sent with hop limit 255 */
+    if (header->next_header == IP_PROTO_ICMPV6 && header->hop_limit == IPV6_HOP_LIMIT_ND &&
+        nd_handle_frame(packet, *offset) == STATUS_SUCCESS) {
+        g_ip_stats.local_delivered++;
+        return STATUS_SUCCESS;
     }
-    
-    /* Decrement Hop Limit */
-    header->hop_limit--;
-    
+
     /* Process extension headers */
     memset(&ext_headers_ctx, 0, sizeof(ext_headers_ctx));
     //ext_headers_ctx.current_header = header->next_hdr;
     ext_headers_ctx.current_header = header->next_header;
     ext_headers_ctx.current_offset = *offset + sizeof(ipv6_header_t);
 
-    status = process_ipv6_extension_headers(packet, &ext_headers_ctx.current_offset, &ext_headers_ctx);
+    /* The parser has already walked an unfragmented chain; reuse where it ended */
+    if (packet_parsed_has(packet, PACKET_PARSED_L3 | PACKET_PARSED_L4) &&
+        packet_l3_offset(packet) == l3_offset &&
+        packet_has_proto(packet, PACKET_PROTO_IPV6) &&
+        !packet_has_proto(packet, PACKET_PROTO_IP_FRAG)) {
+        ext_headers_ctx.next_header = packet->metadata.l4_proto;
+        ext_headers_ctx.current_offset = packet_l4_offset(packet);
+        ext_headers_ctx.has_routing_header = packet_has_proto(packet, PACKET_PROTO_IPV6_ROUTING);
+        status = STATUS_SUCCESS;
+    } else {
+        status = process_ipv6_extension_headers(packet, &ext_headers_ctx.current_offset, &ext_headers_ctx);
+    }
     if (status != STATUS_SUCCESS) {
         LOG_ERROR( LOG_CATEGORY_L3, "Error processing IPv6 extension headers: error=%d", status);
         g_ip_stats.header_errors++;
-        g_ip_stats.dropped_packets++;
+        ip_count_drop(packet, PACKET_DROP_IP_HEADER);
         return status;
     }
 
@@ -1653,51 +3144,69 @@ static status_t process_ipv6_packet(packet_buffer_t *packet, uint16_t *offset) {
     /* Check if packet is destined for us */
     if (is_local_address(&header->dst_addr, true)) {
         LOG_DEBUG(LOG_CATEGORY_L3, "IPv6 packet destined for local delivery");
+        if (ext_headers_ctx.has_fragment_header &&
+            (ext_headers_ctx.frag_offset_flags & (IPV6_FRAG_OFFSET_MASK | IPV6_FRAG_FLAG_M))) {
+            return process_ipv6_fragment(packet, l3_offset, &ext_headers_ctx);
+        }
         g_ip_stats.local_delivered++;
         return deliver_to_local_stack(packet, ext_headers_ctx.next_header);
     }
 
+    /* Check if Hop Limit has expired; only routed packets use up a hop */
+    if (header->hop_limit <= IPV6_HOP_LIMIT_THRESHOLD) {
+        LOG_DEBUG(LOG_CATEGORY_L3, "Hop Limit expired for IPv6 packet");
+        g_ip_stats.ttl_exceeded++;
+        ip_count_drop(packet, PACKET_DROP_TTL_EXCEEDED);
+        /* Send ICMPv6 Time Exceeded message back to source */
+        icmp_send_error(packet, l3_offset, ICMPV6_TYPE_TIME_EXCEEDED, ICMPV6_CODE_HOP_LIMIT, 0);
+        return ERROR_TTL_EXPIRED;
+    }
+
+    /* Decrement Hop Limit */
+    header->hop_limit--;
+
 
     /* Get routing table instance */
     routing_table = routing_table_get_instance();
     if (!routing_table) {
         LOG_ERROR(LOG_CATEGORY_L3, "Failed to get routing table instance");
-        g_ip_stats.dropped_packets++;
+        ip_count_drop(packet, PACKET_DROP_INTERNAL);
         return ERROR_INTERNAL;
     }
 
 //    /* Lookup route for destination */
 //    status = routing_table_lookup_ipv6(&header->dst_addr, &route);
-    /* Lookup route for destination */
+    /* Lookup route for destination; a policy route of the ingress port takes precedence */
     ip_addr_t dest_ip;
     dest_ip.type = IP_TYPE_V6;
     memcpy(&dest_ip.addr.v6, &header->dst_addr, sizeof(ipv6_addr_t));
-    status = routing_table_lookup(routing_table, &dest_ip, IP_TYPE_V6, &route);
+    if (acl_pbr_attached(packet->metadata.port) && policy_route(packet, l3_offset, true, &route)) {
+        status = STATUS_SUCCESS;
+    } else {
+        status = routing_table_lookup(routing_table, &dest_ip, IP_TYPE_V6, &route);
+    }
     if (status != STATUS_SUCCESS) {
         LOG_DEBUG(LOG_CATEGORY_L3, "No route found for IPv6 destination");
-        g_ip_stats.dropped_packets++;
+        ip_count_drop(packet, PACKET_DROP_NO_ROUTE);
         /* Send ICMPv6 Destination Unreachable message */
+        icmp_send_error(packet, l3_offset, ICMPV6_TYPE_DEST_UNREACH, ICMPV6_CODE_NO_ROUTE, 0);
         return ERROR_NO_ROUTE;
     }
 
     /* If the packet exceeds the MTU of the outgoing interface, fragment it */
-    if (packet->size > g_port_mtu_table[route.interface_index]) {
+    if (packet_chain_length(packet) > g_port_mtu_table[route.interface_index]) {
         /* Only fragment if there's no "Don't Fragment" flag
-         * For IPv6, a Fragmentation header would be generated
+         * For IPv6, a Fragmentation header is generated by forward_ip_packet()
+         * once the next hop is resolved
          */
         if (!ext_headers_ctx.has_fragment_header) {
             LOG_DEBUG(LOG_CATEGORY_L3, "IPv6 packet needs fragmentation");
-            g_ip_stats.fragmented_packets++;
-            status = fragment_ipv6_packet(packet, g_port_mtu_table[route.interface_index], route.interface_index);
-            if (status != STATUS_SUCCESS) {
-                LOG_ERROR( LOG_CATEGORY_L3, "IPv6 fragmentation failed: error=%d", status);
-                g_ip_stats.dropped_packets++;
-                return status;
-            }
         } else {
             /* Can't fragment - need to send ICMPv6 Packet Too Big message */
             LOG_DEBUG(LOG_CATEGORY_L3, "IPv6 packet too big and can't be fragmented");
-            g_ip_stats.dropped_packets++;
+            ip_count_drop(packet, PACKET_DROP_FRAG_NEEDED);
+            icmp_send_error(packet, l3_offset, ICMPV6_TYPE_PACKET_TOO_BIG, 0,
+                            g_port_mtu_table[route.interface_index]);
             return ERROR_PACKET_TOO_BIG;
         }
     }
@@ -1707,11 +3216,132 @@ static status_t process_ipv6_packet(packet_buffer_t *packet, uint16_t *offset) {
     return forward_ip_packet(packet, &route);
 }
 
+/**
+ * @brief Queue a locally addressed IPv6 fragment for reassembly
+ *
+ * When the last missing fragment arrives the reassembled packet is
+ * delivered to the local stack.
+ *
+ * @param packet Fragment, still owned by the caller
+ * @param l3_offset Offset of the IPv6 header
+ * @param ctx Extension header context describing the Fragment header
+ * @return STATUS_SUCCESS if the fragment was queued or the packet delivered
+ *         Various error codes on failure
+ */
+static status_t process_ipv6_fragment(packet_buffer_t *packet, uint16_t l3_offset, const ipv6_ext_headers_ctx_t *ctx) {
+    const ipv6_header_t *header = (const ipv6_header_t *)(packet->data + l3_offset);
+    status_t status;
+
+    /* Entries that timed out go first */
+    cleanup_stale_fragments();
+    ipv6_frag_entry_t *frag_entry = find_ipv6_frag_entry(&header->src_addr, &header->dst_addr, ctx->frag_ident);
+
+    if (!frag_entry) {
+        frag_entry = create_ipv6_frag_entry(header, ctx->frag_ident);
+        if (!frag_entry) {
+            LOG_ERROR( LOG_CATEGORY_L3, "Failed to allocate IPv6 fragment entry");
+            ip_count_drop(packet, PACKET_DROP_FRAGMENT);
+            return STATUS_RESOURCE_EXCEEDED;
+        }
+    }
+
+    /* The payload is everything after the Fragment header */
+    uint16_t payload_offset = ctx->frag_hdr_offset + IPV6_FRAG_HEADER_LEN;
+    uint32_t payload_end = (uint32_t)l3_offset + IPV6_HEADER_LEN + ntohs(header->payload_length);
+    uint32_t frag_offset = ctx->frag_offset_flags & IPV6_FRAG_OFFSET_MASK;
+
+    /* A source over its budget loses the datagram instead of starving others */
+    if (payload_end > payload_offset && !frag_source_charge(&frag_entry->timer, payload_end - payload_offset)) {
+        LOG_DEBUG(LOG_CATEGORY_L3, "IPv6 reassembly memory of source exceeded, dropping datagram");
+        remove_ipv6_frag_entry(frag_entry);
+        ip_count_drop(packet, PACKET_DROP_FRAGMENT);
+        return STATUS_RESOURCE_EXCEEDED;
+    }
+
+    status = ERROR_PACKET_MALFORMED;
+    if (payload_end > payload_offset) {
+        status = frag_queue_insert(&frag_entry->queue, packet, l3_offset, ctx->frag_hdr_offset,
+                                   payload_offset, frag_offset, payload_end - payload_offset,
+                                   (ctx->frag_offset_flags & IPV6_FRAG_FLAG_M) == 0);
+    }
+    if (status != STATUS_SUCCESS) {
+        LOG_DEBUG(LOG_CATEGORY_L3, "Dropping IPv6 fragment (ID: %u, offset: %u): error=%d",
+                  ctx->frag_ident, frag_offset, status);
+        ip_count_drop(packet, PACKET_DROP_FRAGMENT);
+        return status;
+    }
+
+    /* The first fragment names the upper layer and where its Next Header field is */
+    if (frag_offset == 0) {
+        frag_entry->next_header = ctx->next_header;
+        frag_entry->prev_nh_offset = ctx->frag_prev_nh_offset;
+    }
+
+    packet_t *reassembled = NULL;
+    status = reassemble_ipv6_fragments(frag_entry, &reassembled);
+
+    if (status == STATUS_SUCCESS) {
+        uint8_t next_header = frag_entry->next_header;
+        remove_ipv6_frag_entry(frag_entry);
+        g_ip_stats.local_delivered++;
+        status = deliver_to_local_stack(reassembled, next_header);
+        packet_buffer_free(reassembled);
+        return status;
+    } else if (status == ERROR_REASSEMBLY_IN_PROGRESS) {
+        return STATUS_SUCCESS;
+    }
+
+    LOG_ERROR( LOG_CATEGORY_L3, "Failed to reassemble IPv6 fragments: error=%d", status);
+    remove_ipv6_frag_entry(frag_entry);
+    ip_count_drop(packet, PACKET_DROP_FRAGMENT);
+    return status;
+}
+
+/**
+ * @brief Leave segmentation of a locally originated TCP packet to the NIC
+ *
+ * Only TCP sent by this system can be resegmented; a forwarded datagram
+ * belongs to its sender and is fragmented as usual.
+ *
+ * @param packet Packet with the IPv4 header at offset
+ * @param offset Offset of the IPv4 header
+ * @param header Fixed IPv4 header
+ * @param mtu Egress MTU
+ * @param egress_port Egress port ID
+ * @return true if the packet is marked for TSO
+ */
+static bool ipv4_tso_prepare(packet_buffer_t *packet, uint16_t offset, const ipv4_header_t *header,
+                             uint16_t mtu, port_id_t egress_port) {
+    uint8_t data_offset;
+
+    if (packet->metadata.port != port_cpu_id() || header->protocol != IP_PROTO_TCP ||
+        (ntohs(header->flags_fragment_offset) & (IP_FLAG_MF | IP_FRAG_OFFSET_MASK)) ||
+        !(hw_sim_get_port_offloads(egress_port) & DRIVER_FLAG_TSO)) {
+        return false;
+    }
+
+    uint16_t header_len = (header->version_ihl & 0x0F) * 4;
+    if (packet_peek_byte(packet, offset + header_len + 12, &data_offset) != STATUS_SUCCESS) {
+        return false;
+    }
+
+    uint16_t headers_len = header_len + (data_offset >> 4) * 4;
+    if (mtu <= headers_len) {
+        return false;
+    }
+
+    packet->metadata.offload |= PACKET_OFFLOAD_TSO | PACKET_OFFLOAD_IP_CSUM | PACKET_OFFLOAD_L4_CSUM;
+    packet->metadata.tso_mss = mtu - headers_len;
+    return true;
+}
+
 /**
  * @brief Forward an IP packet based on routing information
  *
- * Processes a packet for forwarding, updates TTL/hop-limit, performs fragmentation
- * if needed, and sends the packet to the appropriate egress port.
+ * Processes a packet for forwarding, performs fragmentation if needed, and
+ * sends the packet to the appropriate egress port. TTL and hop limit are
+ * handled by the caller; locally originated packets come in through
+ * ip_output_packet().
  *
  * @param packet The packet to forward
  * @param route The routing entry indicating where to send the packet
@@ -1725,225 +3355,176 @@ static status_t forward_ip_packet(packet_buffer_t *packet, const route_entry_t *
 
     uint16_t offset = 0;
     uint8_t version = 0;
+    uint16_t frag_mtu = 0;          // Egress MTU when the datagram must be fragmented
     status_t err;
 
-    // Read the IP version from the packet
-    if (packet_peek_byte(packet, offset, &version) != STATUS_SUCCESS) {
-        LOG_ERROR(LOG_CATEGORY_L3, "Failed to read IP version");
-        g_ip_stats.dropped_packets++;
-        return ERROR_PACKET_OPERATION_FAILED;
+    // Read the IP version, from the header cache when it describes this offset
+    if (packet_parsed_has(packet, PACKET_PARSED_L3) && packet_l3_offset(packet) == offset) {
+        version = packet_has_proto(packet, PACKET_PROTO_IPV6) ? IP_VERSION_6 : IP_VERSION_4;
+    } else {
+        if (packet_peek_byte(packet, offset, &version) != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_L3, "Failed to read IP version");
+            ip_count_drop(packet, PACKET_DROP_IP_HEADER);
+            return ERROR_PACKET_OPERATION_FAILED;
+        }
+        version = (version >> 4) & 0x0F;
     }
 
-    version = (version >> 4) & 0x0F;
-
     if (version == IP_VERSION_4) {
-        ipv4_header_t header;
-
-        // Read the header
-        if (packet_peek_data(packet, offset, &header, sizeof(ipv4_header_t)) != STATUS_SUCCESS) {
+        // Read the header in place; TTL was already used up by process_ipv4_packet()
+        const ipv4_header_t *header = packet_peek_ptr(packet, offset, sizeof(ipv4_header_t));
+        if (!header) {
             LOG_ERROR(LOG_CATEGORY_L3, "Failed to read IPv4 header");
-            g_ip_stats.dropped_packets++;
-            return ERROR_PACKET_OPERATION_FAILED;
-        }
-
-        // Decrement TTL
-        if (header.ttl <= TTL_THRESHOLD) {
-            // TTL would become zero or below, drop the packet and send ICMP time exceeded
-            LOG_DEBUG(LOG_CATEGORY_L3, "IPv4 packet TTL exceeded, dropping packet");
-            g_ip_stats.ttl_exceeded++;
-            g_ip_stats.dropped_packets++;
-
-            // TODO: Generate ICMP Time Exceeded message
-
-            return ERROR_TTL_EXCEEDED;
-        }
-
-        // Update TTL and header checksum
-        header.ttl--;
-        header.header_checksum = 0;
-        header.header_checksum = calculate_ipv4_checksum(&header, (header.version_ihl & 0x0F) * 4);
-
-        // Write the updated header back to the packet
-        if (packet_update_data(packet, offset, &header, sizeof(ipv4_header_t)) != STATUS_SUCCESS) {
-            LOG_ERROR(LOG_CATEGORY_L3, "Failed to update IPv4 header");
-            g_ip_stats.dropped_packets++;
+            ip_count_drop(packet, PACKET_DROP_IP_HEADER);
             return ERROR_PACKET_OPERATION_FAILED;
         }
 
-        // Check if fragmentation is needed
-        uint16_t total_length = ntohs(header.total_length);
+        // Check if fragmentation is needed; it happens once the next hop is known
+        uint16_t total_length = ntohs(header->total_length);
         uint16_t mtu = g_port_mtu_table[route->egress_port];
 
-        if (total_length > mtu && !(ntohs(header.flags_fragment_offset) & IP_FLAG_DF)) {
-            // Need to fragment the packet
-            err = fragment_ipv4_packet(packet, mtu, route->egress_port);
-            if (err != STATUS_SUCCESS) {
-                LOG_ERROR(LOG_CATEGORY_L3, "IPv4 fragmentation failed, error: %d", err);
-                g_ip_stats.dropped_packets++;
-                return err;
+        if (total_length > mtu && ipv4_tso_prepare(packet, offset, header, mtu, route->egress_port)) {
+            // The egress NIC cuts it into MTU-sized segments instead
+            LOG_DEBUG(LOG_CATEGORY_L3, "IPv4 packet of %u bytes left to TSO on port %u, MSS %u",
+                      total_length, route->egress_port, packet->metadata.tso_mss);
+        } else if (total_length > mtu) {
+            if (ntohs(header->flags_fragment_offset) & IP_FLAG_DF) {
+                // The sender asked not to fragment: tell it the MTU for path MTU discovery
+                LOG_DEBUG(LOG_CATEGORY_L3, "IPv4 packet too big with DF set, dropping packet");
+                ip_count_drop(packet, PACKET_DROP_FRAG_NEEDED);
+                icmp_send_error(packet, offset, ICMP_TYPE_DEST_UNREACH, ICMP_CODE_FRAG_NEEDED, mtu);
+                return ERROR_PACKET_TOO_BIG;
             }
-
-            g_ip_stats.fragmented_packets++;
-            LOG_DEBUG(LOG_CATEGORY_L3, "IPv4 packet fragmented for MTU %u", mtu);
-
-            // Fragmentation function handles forwarding
-            return STATUS_SUCCESS;
+            frag_mtu = mtu;
         }
     } else if (version == IP_VERSION_6) {
-        ipv6_header_t header;
-
-        // Read the header
-        if (packet_peek_data(packet, offset, &header, sizeof(ipv6_header_t)) != STATUS_SUCCESS) {
+        // Read the header in place; the hop limit was already used up by process_ipv6_packet()
+        const ipv6_header_t *header = packet_peek_ptr(packet, offset, sizeof(ipv6_header_t));
+        if (!header) {
             LOG_ERROR(LOG_CATEGORY_L3, "Failed to read IPv6 header");
-            g_ip_stats.dropped_packets++;
-            return ERROR_PACKET_OPERATION_FAILED;
-        }
-
-        // Decrement hop limit
-        if (header.hop_limit <= IPV6_HOP_LIMIT_THRESHOLD) {
-            // Hop limit would become zero or below, drop the packet and send ICMPv6 time exceeded
-            LOG_DEBUG(LOG_CATEGORY_L3, "IPv6 packet hop limit exceeded, dropping packet");
-            g_ip_stats.ttl_exceeded++;
-            g_ip_stats.dropped_packets++;
-
-            // TODO: Generate ICMPv6 Time Exceeded message
-
-            return ERROR_TTL_EXCEEDED;
-        }
-
-        // Update hop limit
-        header.hop_limit--;
-
-        // Write the updated header back to the packet
-        if (packet_update_data(packet, offset, &header, sizeof(ipv6_header_t)) != STATUS_SUCCESS) {
-            LOG_ERROR(LOG_CATEGORY_L3, "Failed to update IPv6 header");
-            g_ip_stats.dropped_packets++;
+            ip_count_drop(packet, PACKET_DROP_IP_HEADER);
             return ERROR_PACKET_OPERATION_FAILED;
         }
 
-        // Check if fragmentation is needed
-        uint16_t payload_length = ntohs(header.payload_length);
-        uint16_t total_length = payload_length + IPV6_HEADER_LEN;
+        // Check if fragmentation is needed; it happens once the next hop is known
+        uint16_t payload_length = ntohs(header->payload_length);
+        uint32_t total_length = (uint32_t)payload_length + IPV6_HEADER_LEN;
         uint16_t mtu = g_port_mtu_table[route->egress_port];
 
         if (total_length > mtu) {
-            // Need to fragment the packet
-            err = fragment_ipv6_packet(packet, mtu, route->egress_port);
-            if (err != STATUS_SUCCESS) {
-                LOG_ERROR(LOG_CATEGORY_L3, "IPv6 fragmentation failed, error: %d", err);
-                g_ip_stats.dropped_packets++;
-                return err;
-            }
-
-            g_ip_stats.fragmented_packets++;
-            LOG_DEBUG(LOG_CATEGORY_L3, "IPv6 packet fragmented for MTU %u", mtu);
-
-            // Fragmentation function handles forwarding
-            return STATUS_SUCCESS;
+            frag_mtu = mtu;
         }
     } else {
         LOG_ERROR(LOG_CATEGORY_L3, "Unsupported IP version: %u", version);
-        g_ip_stats.dropped_packets++;
+        ip_count_drop(packet, PACKET_DROP_IP_HEADER);
         return ERROR_UNSUPPORTED_PROTOCOL;
     }
 
     // Forward the packet to the next hop
-    mac_addr_t next_hop_mac;
+    static const ipv6_addr_t ipv6_unspecified;
+    const arp_rewrite_t *rewrite = NULL;
+    ipv4_addr_t next_hop_ip = 0;
+    ipv6_addr_t next_hop_ip6;
+    uint8_t *l2_header = NULL;
 
-    // Get the next hop MAC address
-    // ИСПРАВЛЕНИЕ: используем правильное поле из структуры route_entry_t
+    // Pick the neighbor whose L2 rewrite the packet leaves with
     if (!route->is_ipv6 && route->route.ipv4.gateway != 0) {
-        // Use ARP to resolve the gateway MAC address for IPv4
-        err = arp_get_mac_for_ip(&route->route.ipv4.gateway, route->egress_port, &next_hop_mac);
-    } else if (route->is_ipv6) {
-        // For IPv6, check if next hop is specified
-        // TODO: Implement IPv6 neighbor discovery
-        LOG_ERROR(LOG_CATEGORY_L3, "IPv6 neighbor discovery not fully implemented");
-        g_ip_stats.dropped_packets++;
-        return ERROR_NOT_IMPLEMENTED;
+        next_hop_ip = route->route.ipv4.gateway;
+    } else if (route->is_ipv6 &&
+               memcmp(&route->route.ipv6.next_hop, &ipv6_unspecified, sizeof(ipv6_addr_t)) != 0) {
+        next_hop_ip6 = route->route.ipv6.next_hop;
     } else {
         // Direct delivery, get the destination MAC address
-        ipv4_addr_t dst_ip;
-
         if (version == IP_VERSION_4) {
-            ipv4_header_t header;
-            if (packet_peek_data(packet, offset, &header, sizeof(ipv4_header_t)) != STATUS_SUCCESS) {
+            const ipv4_header_t *header = packet_peek_ptr(packet, offset, sizeof(ipv4_header_t));
+            if (!header) {
                 LOG_ERROR(LOG_CATEGORY_L3, "Failed to read IPv4 header for direct delivery");
-                g_ip_stats.dropped_packets++;
+                ip_count_drop(packet, PACKET_DROP_IP_HEADER);
                 return ERROR_PACKET_OPERATION_FAILED;
             }
-            dst_ip = header.dst_addr;
+            next_hop_ip = header->dst_addr;
         } else {
-            // For IPv6, we'd use Neighbor Discovery, but for simplicity:
-            LOG_ERROR(LOG_CATEGORY_L3, "Direct delivery for IPv6 not fully implemented");
-            g_ip_stats.dropped_packets++;
-            return ERROR_NOT_IMPLEMENTED;
+            const ipv6_header_t *header = packet_peek_ptr(packet, offset, sizeof(ipv6_header_t));
+            if (!header) {
+                LOG_ERROR(LOG_CATEGORY_L3, "Failed to read IPv6 header for direct delivery");
+                ip_count_drop(packet, PACKET_DROP_IP_HEADER);
+                return ERROR_PACKET_OPERATION_FAILED;
+            }
+            next_hop_ip6 = header->dst_addr;
         }
+    }
 
-        err = arp_get_mac_for_ip(&dst_ip,route->egress_port, &next_hop_mac);
+    // The rewrite is read lock-free and only valid inside the read section
+    if (rcu_read_lock() != STATUS_SUCCESS) {
+        ip_count_drop(packet, PACKET_DROP_INTERNAL);
+        return ERROR_INTERNAL;
     }
 
-    if (err != STATUS_SUCCESS) {
-        if (err == ERROR_ENTRY_NOT_FOUND) {
-            // ARP entry not found, trigger ARP resolution
-            LOG_DEBUG(LOG_CATEGORY_L3, "ARP entry not found, queuing packet and triggering ARP resolution");
-
-            // Queue the packet for later transmission
-            // TODO: Implement packet queuing for ARP resolution
-
-            if (version == IP_VERSION_4) {
-                ipv4_header_t header;
-                if (packet_peek_data(packet, offset, &header, sizeof(ipv4_header_t)) != STATUS_SUCCESS) {
-                    LOG_ERROR(LOG_CATEGORY_L3, "Failed to read IPv4 header for ARP resolution");
-                    g_ip_stats.dropped_packets++;
-                    return ERROR_PACKET_OPERATION_FAILED;
-                }
+    // Both families end in the same prebuilt rewrite; only the cache differs
+    if (version == IP_VERSION_6) {
+        err = nd_get_rewrite(&next_hop_ip6, &rewrite);
+    } else {
+        err = arp_get_rewrite(&next_hop_ip, route->egress_port, &rewrite);
+    }
+    if (err == STATUS_SUCCESS && frag_mtu) {
+        // Each fragment carries its own copy of the rewrite
+        arp_rewrite_t l2 = *rewrite;
+        rcu_read_unlock();
+
+        ip_frag_tx_t tx = { .rewrite = &l2, .egress_port = route->egress_port, .version = version };
+        return forward_fragments(packet, frag_mtu, &tx);
+    } else if (err == STATUS_SUCCESS) {
+        // The whole L2 header is one copy into the headroom
+        err = packet_push_header(packet, rewrite->len, &l2_header);
+        if (err == STATUS_SUCCESS) {
+            memcpy(l2_header, rewrite->bytes, rewrite->len);
+            // Later packets of the flow reuse this decision
+            flow_cache_install(packet, route->egress_port, rewrite);
+        }
+        rcu_read_unlock();
 
-                if (!route->is_ipv6 && route->route.ipv4.gateway != 0) {
-                    // Resolve gateway IP
-//                    arp_send_request(route->route.ipv4.gateway);
-                    arp_resolve_async(&route->route.ipv4.gateway, route->egress_port);
-                } else {
-                    // Resolve destination IP
-//                    arp_send_request(header.dst_addr);
-                    arp_resolve_async(&route->route.ipv4.gateway, route->egress_port);
-                }
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_L3, "Failed to prepend L2 header");
+            ip_count_drop(packet, PACKET_DROP_INTERNAL);
+            return ERROR_PACKET_OPERATION_FAILED;
+        }
+    } else {
+        rcu_read_unlock();
+
+        if (err == ARP_STATUS_PENDING || err == ERROR_ENTRY_NOT_FOUND) {
+            // Next hop not resolved yet: hold the packet on the neighbor until the reply.
+            // Only the first packet to a neighbor sends a request, so a burst does not
+            // turn into a burst of ARP requests or Neighbor Solicitations.
+            if (frag_mtu) {
+                ip_frag_tx_t tx = { .rewrite = NULL, .egress_port = route->egress_port, .version = version,
+                                    .next_hop = next_hop_ip, .next_hop6 = next_hop_ip6 };
+                return forward_fragments(packet, frag_mtu, &tx);
+            }
+            if (version == IP_VERSION_6) {
+                err = nd_queue_packet(nd_table_get_instance(), &next_hop_ip6, route->egress_port, packet);
+            } else {
+                err = arp_queue_packet(arp_table_get_instance(), &next_hop_ip, route->egress_port, packet);
+            }
+            if (err != ARP_STATUS_PENDING) {
+                LOG_DEBUG(LOG_CATEGORY_L3, "Packet not held for ARP resolution, error: %d", err);
+                ip_count_drop(packet, PACKET_DROP_NEIGHBOR);
+                return err;
             }
 
+            LOG_DEBUG(LOG_CATEGORY_L3, "Packet held until ARP resolution of its next hop");
             return ERROR_PENDING_RESOLUTION;
         } else {
             LOG_ERROR(LOG_CATEGORY_L3, "Failed to get MAC address for next hop, error: %d", err);
-            g_ip_stats.dropped_packets++;
+            ip_count_drop(packet, PACKET_DROP_NEIGHBOR);
             return err;
         }
     }
 
-    // Update packet Ethernet header with the destination MAC
-    ethernet_header_t eth_header;
-    if (packet_peek_data(packet, 0, &eth_header, sizeof(ethernet_header_t)) != STATUS_SUCCESS) {
-        LOG_ERROR(LOG_CATEGORY_L3, "Failed to read Ethernet header");
-        g_ip_stats.dropped_packets++;
-        return ERROR_PACKET_OPERATION_FAILED;
-    }
-
-    // Set the destination MAC to the next hop
-    memcpy(&eth_header.dst_mac, next_hop_mac.addr, MAC_ADDR_LEN);
-
-    // Get the egress port's MAC address for the source
-    port_get_mac(route->egress_port, &eth_header.src_mac);
-
-    // Update the Ethernet header
-    if (packet_update_data(packet, 0, &eth_header, sizeof(ethernet_header_t)) != STATUS_SUCCESS) {
-        LOG_ERROR(LOG_CATEGORY_L3, "Failed to update Ethernet header");
-        g_ip_stats.dropped_packets++;
-        return ERROR_PACKET_OPERATION_FAILED;
-    }
-
     // Send the packet out the egress port
     err = port_send_packet(route->egress_port, packet);
     if (err != STATUS_SUCCESS) {
         LOG_ERROR(LOG_CATEGORY_L3, "Failed to send packet on port %u, error: %d", route->egress_port, err);
-        g_ip_stats.dropped_packets++;
+        ip_count_drop(packet, PACKET_DROP_TX_ERROR);
         return err;
     }
 
@@ -1954,17 +3535,64 @@ static status_t forward_ip_packet(packet_buffer_t *packet, const route_entry_t *
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Send one copy made by the multicast FIB
+ */
+static status_t ip_mcast_transmit(port_id_t port_id, packet_buffer_t *packet, void *arg) {
+    (void)arg;
+    return port_send_packet(port_id, packet);
+}
+
+/**
+ * @brief Replicate an IPv4 multicast datagram through the multicast FIB
+ *
+ * The datagram is left untouched: every copy gets its own routed header
+ * and shares the payload. No ICMP errors are sent for multicast.
+ *
+ * @param packet Packet buffer
+ * @param offset Offset of the IPv4 header
+ * @return status_t Status code
+ */
+static status_t forward_ipv4_multicast(packet_buffer_t *packet, uint16_t offset) {
+    uint32_t copies = 0;
+    status_t status = mfib_forward(packet, offset, packet->metadata.port, packet->metadata.vlan,
+                                   ip_mcast_transmit, NULL, &copies);
+
+    if (status == STATUS_SUCCESS) {
+        g_ip_stats.forwarded_packets++;
+        LOG_DEBUG(LOG_CATEGORY_L3, "Multicast datagram replicated to %u interfaces", copies);
+        return STATUS_SUCCESS;
+    }
+    if (status == STATUS_INVALID_PACKET) {
+        /* The header was validated already, so the TTL ran out */
+        g_ip_stats.ttl_exceeded++;
+        ip_count_drop(packet, PACKET_DROP_TTL_EXCEEDED);
+        return ERROR_TTL_EXPIRED;
+    }
+    if (status == STATUS_NOT_FOUND || status == STATUS_PERMISSION_DENIED || status == STATUS_NOT_INITIALIZED) {
+        /* No route, or it arrived off the RPF interface */
+        ip_count_drop(packet, PACKET_DROP_NO_ROUTE);
+        return ERROR_NO_ROUTE;
+    }
+    ip_count_drop(packet, PACKET_DROP_INTERNAL);
+    return status;
+}
+
 /**
  * @brief Deliver a packet to the local protocol stack
  *
- * Processes a packet destined for the local system.
+ * Processes a packet destined for the local system. The packet is not
+ * handled here: a reference is queued on the punt path, where the policer
+ * of its protocol class decides whether the control plane sees it.
  *
- * @param packet The packet to deliver
+ * @param packet The packet to deliver, still owned by the caller
  * @param protocol The protocol identifier
  * @return STATUS_SUCCESS if delivery is successful
  *         Other error code if delivery fails
  */
 static status_t deliver_to_local_stack(packet_buffer_t *packet, uint8_t protocol) {
+    punt_class_t cls;
+
     if (!packet) {
         return ERROR_INVALID_PARAMETER;
     }
@@ -1972,56 +3600,55 @@ static status_t deliver_to_local_stack(packet_buffer_t *packet, uint8_t protocol
     // Update statistics
     g_ip_stats.local_delivered++;
     
-    // In a real implementation, we would dispatch to the appropriate protocol handler
     switch (protocol) {
         case IP_PROTO_ICMP:
-            LOG_DEBUG(LOG_CATEGORY_L3, "Delivering ICMP packet to local stack");
-            // TODO: Call ICMP processing function
-            // icmp_process_packet(packet);
-            return STATUS_SUCCESS;
-            // break;
+        case IP_PROTO_ICMPV6:
+            cls = PUNT_CLASS_ICMP;
+            break;
             
         case IP_PROTO_IGMP:
-            LOG_DEBUG(LOG_CATEGORY_L3, "Delivering IGMP packet to local stack");
-            // TODO: Call IGMP processing function
-            // igmp_process_packet(packet);
-            return STATUS_SUCCESS;
-            // break;
+            cls = PUNT_CLASS_IGMP;
+            break;
 
-        case IP_PROTO_TCP:
-            LOG_DEBUG(LOG_CATEGORY_L3, "Delivering TCP packet to local stack");
-            // TODO: Call TCP processing function
-            // tcp_process_packet(packet);
-            return STATUS_SUCCESS;
-            // break;
-            
-        case IP_PROTO_UDP:
-            LOG_DEBUG(LOG_CATEGORY_L3, "Delivering UDP packet to local stack");
-            // TODO: Call UDP processing function
-            // udp_process_packet(packet);
-            return STATUS_SUCCESS;
-            // break;
-            
         case IP_PROTO_OSPF:
-            LOG_DEBUG(LOG_CATEGORY_L3, "Delivering OSPF packet to local stack");
-            // TODO: Call OSPF processing function
-            // ospf_process_packet(packet);
-            return STATUS_SUCCESS;
-            // break;
+            cls = PUNT_CLASS_OSPF;
+            break;
             
-        case IP_PROTO_ICMPV6:
-            LOG_DEBUG(LOG_CATEGORY_L3, "Delivering ICMPv6 packet to local stack");
-            // TODO: Call ICMPv6 processing function
-            // icmpv6_process_packet(packet);
-            return STATUS_SUCCESS;
-            // break;
+        case IP_PROTO_UDP: {
+            // RIP and BFD are told apart by their well-known ports
+            const uint8_t *udp;
+            uint16_t dst_port;
+            cls = PUNT_CLASS_OTHER;
+            if (packet_ensure_parsed(packet) == STATUS_SUCCESS &&
+                packet_has_proto(packet, PACKET_PROTO_UDP) &&
+                (udp = packet_peek_ptr(packet, packet_l4_offset(packet), 4)) != NULL) {
+                memcpy(&dst_port, udp + 2, sizeof(dst_port));
+                if (ntohs(dst_port) == PUNT_RIP_UDP_PORT || ntohs(dst_port) == PUNT_RIPNG_UDP_PORT) {
+                    cls = PUNT_CLASS_RIP;
+                } else if (ntohs(dst_port) == PUNT_BFD_UDP_PORT) {
+                    cls = PUNT_CLASS_BFD;
+                }
+            }
+            break;
+        }
+
+        case IP_PROTO_TCP:
+            cls = PUNT_CLASS_OTHER;
+            break;
             
         default:
             LOG_WARNING(LOG_CATEGORY_L3, "Unsupported protocol (%u) for local delivery", protocol);
-            g_ip_stats.dropped_packets++;
+            ip_count_drop(packet, PACKET_DROP_PUNT);
             return ERROR_UNSUPPORTED_PROTOCOL;
             // break;
     }
+
+    status_t status = punt_packet(packet, cls);
+    if (status != STATUS_SUCCESS) {
+        LOG_DEBUG(LOG_CATEGORY_L3, "Packet for the local stack not punted (protocol %u): error=%d", protocol, status);
+        ip_count_drop(packet, PACKET_DROP_PUNT);
+    }
+    return status;
 }
 
 
@@ -0,0 +1,682 @@
+/**
+ * @file mcast_fib.c
+ * @brief Implementation of the IPv4 multicast forwarding table
+ *
+ * Routes are nodes of a chained hash table keyed by (source, group), the
+ * bucket array sized once for the configured capacity. Readers walk the
+ * chains under RCU; writers hold the state lock, link new nodes at the
+ * head of their chain with one release store and retire unlinked ones.
+ *
+ * The incoming interface and the outgoing interfaces of a route form one
+ * immutable list object. Every change builds a new list, publishes it
+ * with an atomic exchange and retires the old one, so the RPF check and
+ * the replication of a datagram always see the same version of a route.
+ * Per-route counters are updated with relaxed atomics.
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/config.h"
+#include "common/logging.h"
+#include "common/threading.h"
+#include "common/rcu.h"
+#include "common/switch_context.h"
+#include "hal/packet.h"
+#include "hal/packet_offload.h"
+#include "l2/vlan.h"
+#include "l3/mcast_fib.h"
+
+#define MFIB_IPV4_MIN_LEN       20
+#define MFIB_IPV4_TTL_OFF       8
+#define MFIB_IPV4_CSUM_OFF      10
+#define MFIB_ETH_HLEN           14
+#define MFIB_VLAN_HLEN          4
+#define MFIB_ETHERTYPE_IPV4     0x0800
+#define MFIB_ETHERTYPE_VLAN     0x8100
+
+/**
+ * @brief Incoming and outgoing interfaces of a route, never changed once published
+ */
+typedef struct {
+    rcu_head_t rcu;
+    port_id_t iif;
+    vlan_id_t iif_vlan;
+    uint32_t count;
+    mfib_oif_t oifs[];
+} mfib_list_t;
+
+/**
+ * @brief Route
+ */
+typedef struct mfib_node {
+    rcu_head_t rcu;
+    struct mfib_node *next;         // Chain link, read lock-free
+    ipv4_addr_t source;
+    ipv4_addr_t group;
+    mfib_list_t *list;              // Current interfaces, never NULL
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t rpf_failures;
+} mfib_node_t;
+
+/**
+ * @brief Multicast FIB of one switch instance
+ */
+typedef struct {
+    bool initialized;
+    spinlock_t lock;                // Serializes writers
+    mfib_node_t **buckets;
+    uint32_t bucket_mask;           // Number of buckets - 1
+    uint32_t max_routes;
+    uint32_t routes;
+    mfib_stats_t stats;             // Updated atomically, routes aside
+} mfib_state_t;
+
+/**
+ * @brief Multicast FIB of each switch instance
+ *
+ * Instance 0 is static; mfib_init() allocates the others.
+ */
+static mfib_state_t g_mfib_state_default;
+static mfib_state_t *g_mfib_states[CONFIG_MAX_SWITCH_INSTANCES] = { &g_mfib_state_default };
+
+/**
+ * @brief State of the calling thread's instance, NULL if never initialized
+ */
+static inline mfib_state_t *mfib_state(void) {
+    return g_mfib_states[switch_context_current()];
+}
+
+static inline uint16_t mfib_read16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t mfib_read32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void mfib_write16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static inline bool mfib_is_multicast(ipv4_addr_t addr) {
+    return (addr & 0xF0000000u) == 0xE0000000u;
+}
+
+static inline uint32_t mfib_bucket(const mfib_state_t *st, ipv4_addr_t source, ipv4_addr_t group) {
+    // Murmur3 finalizer over both addresses
+    uint64_t h = ((uint64_t)source << 32) | group;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (uint32_t)h & st->bucket_mask;
+}
+
+/**
+ * @brief Find a route; lock-free under RCU or with the lock held
+ */
+static mfib_node_t *mfib_find(const mfib_state_t *st, ipv4_addr_t source, ipv4_addr_t group) {
+    mfib_node_t *node = __atomic_load_n(&st->buckets[mfib_bucket(st, source, group)], __ATOMIC_ACQUIRE);
+
+    while (node && (node->source != source || node->group != group)) {
+        node = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+    }
+    return node;
+}
+
+static void mfib_list_free(rcu_head_t *head) {
+    free((mfib_list_t *)((char *)head - offsetof(mfib_list_t, rcu)));
+}
+
+static void mfib_node_free(rcu_head_t *head) {
+    mfib_node_t *node = (mfib_node_t *)((char *)head - offsetof(mfib_node_t, rcu));
+
+    // Readers of the node were the only readers of its list
+    free(node->list);
+    free(node);
+}
+
+/**
+ * @brief Allocate a list of count interfaces, copying the first copy ones of from
+ */
+static mfib_list_t *mfib_list_copy(const mfib_list_t *from, uint32_t count, uint32_t copy) {
+    mfib_list_t *list = (mfib_list_t *)calloc(1, sizeof(mfib_list_t) + count * sizeof(mfib_oif_t));
+
+    if (!list) {
+        LOG_ERROR(LOG_CATEGORY_L3, "MFIB: Failed to allocate a list of %u interfaces", count);
+        return NULL;
+    }
+    list->count = count;
+    if (from) {
+        list->iif = from->iif;
+        list->iif_vlan = from->iif_vlan;
+        memcpy(list->oifs, from->oifs, copy * sizeof(mfib_oif_t));
+    }
+    return list;
+}
+
+/**
+ * @brief Publish a new list for a route; must be called with the lock held
+ */
+static void mfib_publish(mfib_node_t *node, mfib_list_t *list) {
+    mfib_list_t *old = __atomic_exchange_n(&node->list, list, __ATOMIC_ACQ_REL);
+    rcu_retire(&old->rcu, mfib_list_free);
+}
+
+/**
+ * @brief Index of an outgoing interface in a list, or the list's count
+ */
+static uint32_t mfib_oif_index(const mfib_list_t *list, port_id_t port_id, vlan_id_t vlan_id) {
+    uint32_t i;
+
+    for (i = 0; i < list->count; i++) {
+        if (list->oifs[i].port_id == port_id && list->oifs[i].vlan_id == vlan_id) {
+            break;
+        }
+    }
+    return i;
+}
+
+/**
+ * @brief Initialize the multicast FIB of the current switch instance
+ *
+ * @param max_routes Table capacity, 0 for the default
+ * @return status_t Status code
+ */
+status_t mfib_init(uint32_t max_routes) {
+    uint32_t instance = switch_context_current();
+    mfib_state_t *st;
+    uint32_t buckets = 16;
+
+    if (max_routes == 0) {
+        max_routes = CONFIG_MFIB_MAX_ROUTES;
+    }
+    // Chains stay at one route on average when full
+    while (buckets < max_routes) {
+        buckets *= 2;
+    }
+
+    if (g_mfib_states[instance] == NULL) {
+        g_mfib_states[instance] = (mfib_state_t *)calloc(1, sizeof(mfib_state_t));
+        if (!g_mfib_states[instance]) {
+            LOG_ERROR(LOG_CATEGORY_L3, "MFIB: Failed to allocate state of switch instance %u", instance);
+            return STATUS_NO_MEMORY;
+        }
+    }
+    st = g_mfib_states[instance];
+
+    if (st->initialized) {
+        LOG_WARNING(LOG_CATEGORY_L3, "MFIB: Module already initialized");
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    st->buckets = (mfib_node_t **)calloc(buckets, sizeof(mfib_node_t *));
+    if (!st->buckets) {
+        LOG_ERROR(LOG_CATEGORY_L3, "MFIB: Failed to allocate a table of %u routes", max_routes);
+        return STATUS_NO_MEMORY;
+    }
+
+    spinlock_init(&st->lock);
+    st->bucket_mask = buckets - 1;
+    st->max_routes = max_routes;
+    st->routes = 0;
+    memset(&st->stats, 0, sizeof(st->stats));
+    __atomic_store_n(&st->initialized, true, __ATOMIC_RELEASE);
+
+    LOG_INFO(LOG_CATEGORY_L3, "MFIB: Initialized, %u routes", max_routes);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Delete every route and free the table of the current instance
+ *
+ * @return status_t Status code
+ */
+status_t mfib_deinit(void) {
+    uint32_t instance = switch_context_current();
+    mfib_state_t *st = g_mfib_states[instance];
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    spinlock_acquire(&st->lock);
+    __atomic_store_n(&st->initialized, false, __ATOMIC_RELEASE);
+    for (uint32_t b = 0; b <= st->bucket_mask; b++) {
+        mfib_node_t *node = __atomic_exchange_n(&st->buckets[b], NULL, __ATOMIC_ACQ_REL);
+        while (node) {
+            mfib_node_t *next = node->next;
+            rcu_retire(&node->rcu, mfib_node_free);
+            node = next;
+        }
+    }
+    st->routes = 0;
+    spinlock_release(&st->lock);
+
+    rcu_synchronize();
+    free(st->buckets);
+    st->buckets = NULL;
+    if (instance != SWITCH_INSTANCE_DEFAULT) {
+        g_mfib_states[instance] = NULL;
+        free(st);
+    }
+
+    LOG_INFO(LOG_CATEGORY_L3, "MFIB: Cleaned up");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Add a route or change its incoming interface
+ *
+ * @param source Source, host order
+ * @param group Group, host order
+ * @param iif RPF port
+ * @param iif_vlan RPF VLAN
+ * @return status_t Status code
+ */
+status_t mfib_route_add(ipv4_addr_t source, ipv4_addr_t group, port_id_t iif, vlan_id_t iif_vlan) {
+    mfib_state_t *st = mfib_state();
+    status_t status = STATUS_SUCCESS;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!mfib_is_multicast(group) || mfib_is_multicast(source)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    mfib_node_t *node = mfib_find(st, source, group);
+    if (node) {
+        const mfib_list_t *cur = node->list;
+        if (cur->iif != iif || cur->iif_vlan != iif_vlan) {
+            mfib_list_t *list = mfib_list_copy(cur, cur->count, cur->count);
+            if (list) {
+                list->iif = iif;
+                list->iif_vlan = iif_vlan;
+                mfib_publish(node, list);
+            } else {
+                status = STATUS_NO_MEMORY;
+            }
+        }
+    } else if (st->routes >= st->max_routes) {
+        status = STATUS_TABLE_FULL;
+    } else {
+        node = (mfib_node_t *)calloc(1, sizeof(mfib_node_t));
+        mfib_list_t *list = mfib_list_copy(NULL, 0, 0);
+        if (node && list) {
+            uint32_t b = mfib_bucket(st, source, group);
+            list->iif = iif;
+            list->iif_vlan = iif_vlan;
+            node->source = source;
+            node->group = group;
+            node->list = list;
+            node->next = st->buckets[b];
+            __atomic_store_n(&st->buckets[b], node, __ATOMIC_RELEASE);
+            st->routes++;
+        } else {
+            free(node);
+            free(list);
+            status = STATUS_NO_MEMORY;
+        }
+    }
+    spinlock_release(&st->lock);
+
+    if (status == STATUS_TABLE_FULL) {
+        LOG_WARNING(LOG_CATEGORY_L3, "MFIB: Table full, route to group %u.%u.%u.%u refused",
+                    IPV4_OCTET1(group), IPV4_OCTET2(group), IPV4_OCTET3(group), IPV4_OCTET4(group));
+    }
+    return status;
+}
+
+/**
+ * @brief Delete a route
+ *
+ * @param source Source
+ * @param group Group
+ * @return status_t Status code
+ */
+status_t mfib_route_delete(ipv4_addr_t source, ipv4_addr_t group) {
+    mfib_state_t *st = mfib_state();
+    mfib_node_t *node;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    spinlock_acquire(&st->lock);
+    mfib_node_t **link = &st->buckets[mfib_bucket(st, source, group)];
+    while ((node = *link) != NULL && (node->source != source || node->group != group)) {
+        link = &node->next;
+    }
+    if (node) {
+        // Readers on the node still find the rest of the chain through it
+        __atomic_store_n(link, node->next, __ATOMIC_RELEASE);
+        st->routes--;
+    }
+    spinlock_release(&st->lock);
+
+    if (!node) {
+        return STATUS_NOT_FOUND;
+    }
+    rcu_retire(&node->rcu, mfib_node_free);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Add an outgoing interface to a route or update it
+ *
+ * @param source Source
+ * @param group Group
+ * @param oif Interface
+ * @return status_t Status code
+ */
+status_t mfib_oif_add(ipv4_addr_t source, ipv4_addr_t group, const mfib_oif_t *oif) {
+    mfib_state_t *st = mfib_state();
+    status_t status = STATUS_SUCCESS;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!oif || oif->vlan_id > VLAN_ID_MAX) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    mfib_node_t *node = mfib_find(st, source, group);
+    if (!node) {
+        status = STATUS_NOT_FOUND;
+    } else {
+        const mfib_list_t *cur = node->list;
+        uint32_t i = mfib_oif_index(cur, oif->port_id, oif->vlan_id);
+        if (i < cur->count && memcmp(&cur->oifs[i], oif, sizeof(*oif)) == 0) {
+            // Already there as it is
+        } else if (i == cur->count && cur->count >= CONFIG_MFIB_MAX_OIFS) {
+            status = STATUS_RESOURCE_EXHAUSTED;
+        } else {
+            uint32_t count = i < cur->count ? cur->count : cur->count + 1;
+            mfib_list_t *list = mfib_list_copy(cur, count, cur->count);
+            if (list) {
+                list->oifs[i] = *oif;
+                mfib_publish(node, list);
+            } else {
+                status = STATUS_NO_MEMORY;
+            }
+        }
+    }
+    spinlock_release(&st->lock);
+    return status;
+}
+
+/**
+ * @brief Remove an outgoing interface from a route
+ *
+ * @param source Source
+ * @param group Group
+ * @param port_id Port of the interface
+ * @param vlan_id VLAN of the interface
+ * @return status_t Status code
+ */
+status_t mfib_oif_remove(ipv4_addr_t source, ipv4_addr_t group, port_id_t port_id, vlan_id_t vlan_id) {
+    mfib_state_t *st = mfib_state();
+    status_t status = STATUS_SUCCESS;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    spinlock_acquire(&st->lock);
+    mfib_node_t *node = mfib_find(st, source, group);
+    const mfib_list_t *cur = node ? node->list : NULL;
+    uint32_t i = cur ? mfib_oif_index(cur, port_id, vlan_id) : 0;
+    if (!cur || i == cur->count) {
+        status = STATUS_NOT_FOUND;
+    } else {
+        // The last interface takes the place of the removed one
+        mfib_list_t *list = mfib_list_copy(cur, cur->count - 1, cur->count - 1);
+        if (list) {
+            if (i < list->count) {
+                list->oifs[i] = cur->oifs[cur->count - 1];
+            }
+            mfib_publish(node, list);
+        } else {
+            status = STATUS_NO_MEMORY;
+        }
+    }
+    spinlock_release(&st->lock);
+    return status;
+}
+
+/**
+ * @brief Get a route
+ *
+ * @param source Source
+ * @param group Group
+ * @param route Route and counters
+ * @return status_t Status code
+ */
+status_t mfib_route_get(ipv4_addr_t source, ipv4_addr_t group, mfib_route_t *route) {
+    mfib_state_t *st = mfib_state();
+    status_t status = STATUS_SUCCESS;
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!route) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&st->lock);
+    const mfib_node_t *node = mfib_find(st, source, group);
+    if (node) {
+        const mfib_list_t *list = node->list;
+        route->source = source;
+        route->group = group;
+        route->iif = list->iif;
+        route->iif_vlan = list->iif_vlan;
+        route->packets = __atomic_load_n(&node->packets, __ATOMIC_RELAXED);
+        route->bytes = __atomic_load_n(&node->bytes, __ATOMIC_RELAXED);
+        route->rpf_failures = __atomic_load_n(&node->rpf_failures, __ATOMIC_RELAXED);
+        route->oif_count = list->count;
+        memcpy(route->oifs, list->oifs, list->count * sizeof(mfib_oif_t));
+    } else {
+        status = STATUS_NOT_FOUND;
+    }
+    spinlock_release(&st->lock);
+    return status;
+}
+
+/**
+ * @brief Build one copy: a header segment from the template, then a slice of the payload
+ *
+ * @return The copy, or NULL without buffers
+ */
+static packet_buffer_t *mfib_copy(const packet_buffer_t *packet, const uint8_t *hdr, uint32_t hdr_len,
+                                  uint32_t payload_off, uint32_t payload_len, const mfib_oif_t *oif) {
+    packet_buffer_t *seg = packet_segment_alloc();
+    packet_buffer_t *payload = payload_len ? packet_buffer_slice(packet, payload_off, payload_len) : NULL;
+
+    if (!seg || (payload_len && !payload) || packet_append_data(seg, hdr, hdr_len) != STATUS_SUCCESS) {
+        if (seg) {
+            packet_buffer_free(seg);
+        }
+        if (payload) {
+            packet_buffer_free(payload);
+        }
+        return NULL;
+    }
+
+    memcpy(seg->data + MAC_ADDR_LEN, oif->src_mac.addr, MAC_ADDR_LEN);
+    if (oif->tagged) {
+        mfib_write16(seg->data + MFIB_ETH_HLEN, (uint16_t)(((uint16_t)packet->metadata.priority << 13) |
+                                                           oif->vlan_id));
+    }
+
+    seg->metadata = packet->metadata;
+    memcpy(&seg->metadata.dst_mac, hdr, MAC_ADDR_LEN);
+    seg->metadata.src_mac = oif->src_mac;
+    seg->metadata.port = oif->port_id;
+    seg->metadata.vlan = oif->vlan_id;
+    seg->metadata.is_tagged = oif->tagged;
+    seg->metadata.ethertype = MFIB_ETHERTYPE_IPV4;
+    seg->metadata.offload &= (uint16_t)~PACKET_OFFLOAD_TX_MASK;
+    seg->metadata.tso_mss = 0;
+    packet_invalidate_parse(seg);
+    if (payload) {
+        packet_chain_append(seg, payload);
+    }
+    return seg;
+}
+
+/**
+ * @brief Replicate a datagram to the outgoing interfaces of its route
+ *
+ * @param packet Frame received
+ * @param l3_offset Offset of the IPv4 header
+ * @param in_port Ingress port
+ * @param in_vlan Ingress VLAN
+ * @param transmit Sends each copy
+ * @param arg Argument of transmit
+ * @param copies Copies sent
+ * @return status_t Status code
+ */
+status_t mfib_forward(const packet_buffer_t *packet, uint16_t l3_offset, port_id_t in_port, vlan_id_t in_vlan,
+                      mfib_transmit_fn transmit, void *arg, uint32_t *copies) {
+    mfib_state_t *st = mfib_state();
+    uint8_t untagged[MFIB_ETH_HLEN + 60];
+    uint8_t tagged[MFIB_ETH_HLEN + MFIB_VLAN_HLEN + 60];
+    uint32_t sent = 0;
+
+    if (copies) {
+        *copies = 0;
+    }
+    if (!st || !__atomic_load_n(&st->initialized, __ATOMIC_ACQUIRE)) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!packet || !transmit) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if ((uint32_t)l3_offset + MFIB_IPV4_MIN_LEN > packet->size) {
+        return STATUS_INVALID_PACKET;
+    }
+    const uint8_t *ip = packet->data + l3_offset;
+    uint32_t ihl = (uint32_t)(ip[0] & 0x0F) * 4;
+    if ((ip[0] >> 4) != 4 || ihl < MFIB_IPV4_MIN_LEN || l3_offset + ihl > packet->size) {
+        return STATUS_INVALID_PACKET;
+    }
+    uint32_t total = mfib_read16(ip + 2);
+    ipv4_addr_t source = mfib_read32(ip + 12);
+    ipv4_addr_t group = mfib_read32(ip + 16);
+    if (total < ihl || l3_offset + total > packet_chain_length(packet) || !mfib_is_multicast(group)) {
+        return STATUS_INVALID_PACKET;
+    }
+    if (ip[MFIB_IPV4_TTL_OFF] <= 1) {
+        __atomic_fetch_add(&st->stats.ttl_expired, 1, __ATOMIC_RELAXED);
+        return STATUS_INVALID_PACKET;
+    }
+
+    if (rcu_read_lock() != STATUS_SUCCESS) {
+        return STATUS_NO_MEMORY;
+    }
+    mfib_node_t *node = mfib_find(st, source, group);
+    if (!node) {
+        node = mfib_find(st, MFIB_ANY_SOURCE, group);
+    }
+    if (!node) {
+        rcu_read_unlock();
+        __atomic_fetch_add(&st->stats.no_route, 1, __ATOMIC_RELAXED);
+        return STATUS_NOT_FOUND;
+    }
+    const mfib_list_t *list = __atomic_load_n(&node->list, __ATOMIC_ACQUIRE);
+    if (list->iif != PORT_ID_INVALID &&
+        (in_port != list->iif || (list->iif_vlan != 0 && in_vlan != list->iif_vlan))) {
+        rcu_read_unlock();
+        __atomic_fetch_add(&node->rpf_failures, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&st->stats.rpf_failures, 1, __ATOMIC_RELAXED);
+        return STATUS_PERMISSION_DENIED;
+    }
+
+    // The routed header is built once; every copy starts with one of the two templates
+    uint8_t *tip = untagged + MFIB_ETH_HLEN;
+    untagged[0] = 0x01;
+    untagged[1] = 0x00;
+    untagged[2] = 0x5E;
+    untagged[3] = (uint8_t)((group >> 16) & 0x7F);
+    untagged[4] = (uint8_t)(group >> 8);
+    untagged[5] = (uint8_t)group;
+    mfib_write16(untagged + 12, MFIB_ETHERTYPE_IPV4);
+    memcpy(tip, ip, ihl);
+    // RFC 1624 incremental update for the TTL word
+    uint16_t old_word = mfib_read16(tip + MFIB_IPV4_TTL_OFF);
+    tip[MFIB_IPV4_TTL_OFF]--;
+    uint32_t sum = (uint16_t)~mfib_read16(tip + MFIB_IPV4_CSUM_OFF);
+    sum += (uint16_t)~old_word;
+    sum += mfib_read16(tip + MFIB_IPV4_TTL_OFF);
+    mfib_write16(tip + MFIB_IPV4_CSUM_OFF, packet_csum_fold(sum));
+
+    memcpy(tagged, untagged, 12);
+    mfib_write16(tagged + 12, MFIB_ETHERTYPE_VLAN);
+    mfib_write16(tagged + MFIB_ETH_HLEN + 2, MFIB_ETHERTYPE_IPV4);
+    memcpy(tagged + MFIB_ETH_HLEN + MFIB_VLAN_HLEN, tip, ihl);
+
+    for (uint32_t i = 0; i < list->count; i++) {
+        const mfib_oif_t *oif = &list->oifs[i];
+        if (oif->port_id == in_port && oif->vlan_id == in_vlan) {
+            continue;
+        }
+
+        packet_buffer_t *copy = oif->tagged ?
+            mfib_copy(packet, tagged, MFIB_ETH_HLEN + MFIB_VLAN_HLEN + ihl, l3_offset + ihl, total - ihl, oif) :
+            mfib_copy(packet, untagged, MFIB_ETH_HLEN + ihl, l3_offset + ihl, total - ihl, oif);
+        if (!copy) {
+            __atomic_fetch_add(&st->stats.no_buffer, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (transmit(oif->port_id, copy, arg) == STATUS_SUCCESS) {
+            sent++;
+        }
+        packet_buffer_free(copy);
+    }
+    __atomic_fetch_add(&node->packets, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&node->bytes, packet_chain_length(packet), __ATOMIC_RELAXED);
+    rcu_read_unlock();
+
+    __atomic_fetch_add(&st->stats.forwarded, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&st->stats.copies, sent, __ATOMIC_RELAXED);
+    if (copies) {
+        *copies = sent;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the table counters
+ *
+ * @param stats Counters
+ * @return status_t Status code
+ */
+status_t mfib_get_stats(mfib_stats_t *stats) {
+    mfib_state_t *st = mfib_state();
+
+    if (!st || !st->initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    stats->routes = __atomic_load_n(&st->routes, __ATOMIC_RELAXED);
+    stats->forwarded = __atomic_load_n(&st->stats.forwarded, __ATOMIC_RELAXED);
+    stats->copies = __atomic_load_n(&st->stats.copies, __ATOMIC_RELAXED);
+    stats->no_route = __atomic_load_n(&st->stats.no_route, __ATOMIC_RELAXED);
+    stats->rpf_failures = __atomic_load_n(&st->stats.rpf_failures, __ATOMIC_RELAXED);
+    stats->ttl_expired = __atomic_load_n(&st->stats.ttl_expired, __ATOMIC_RELAXED);
+    stats->no_buffer = __atomic_load_n(&st->stats.no_buffer, __ATOMIC_RELAXED);
+    return STATUS_SUCCESS;
+}
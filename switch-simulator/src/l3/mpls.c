@@ -0,0 +1,597 @@
+/**
+ * @file mpls.c
+ * @brief Implementation of MPLS label switching
+ *
+ * The LFIB is one array of entry pointers indexed by label. An entry is
+ * immutable once published: it is replaced with one pointer exchange and
+ * freed through RCU, so the stage reads it without a lock. Each entry
+ * holds the Ethernet header of its next hop and its out labels already
+ * shifted into place, leaving the stage to OR in the traffic class, TTL
+ * and bottom of stack bit.
+ *
+ * Configuration is serialized by the module lock.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "common/types.h"
+#include "common/error_codes.h"
+#include "common/config.h"
+#include "common/logging.h"
+#include "common/mem_account.h"
+#include "common/threading.h"
+#include "common/rcu.h"
+#include "common/stats_shard.h"
+#include "hal/hw_simulation.h"
+#include "hal/packet_drop.h"
+#include "hal/port.h"
+#include "l2/lag.h"
+#include "l3/mpls.h"
+
+#define MPLS_ETH_HLEN           14
+#define MPLS_ETH_ADDRS_LEN      (2 * MAC_ADDR_LEN)
+#define MPLS_LSE_LEN            4
+
+/**
+ * @brief Fields of a label stack entry
+ */
+#define MPLS_LSE_LABEL_SHIFT    12
+#define MPLS_LSE_TC_MASK        0x00000E00u
+#define MPLS_LSE_TC_SHIFT       9
+#define MPLS_LSE_BOS            0x00000100u
+#define MPLS_LSE_TTL_MASK       0x000000FFu
+
+#define MPLS_ETHERTYPE_IPV4     0x0800
+#define MPLS_ETHERTYPE_IPV6     0x86DD
+
+/**
+ * @brief Counters, by index in the stats_shard set
+ */
+enum {
+    MPLS_CTR_SWAPPED = 0,
+    MPLS_CTR_PUSHED,
+    MPLS_CTR_POPPED,
+    MPLS_CTR_TERMINATED,
+    MPLS_CTR_UNKNOWN_LABEL,
+    MPLS_CTR_RESERVED_LABEL,
+    MPLS_CTR_BAD_STACK,
+    MPLS_CTR_TTL_EXPIRED,
+    MPLS_CTR_TX_DROPS,
+    MPLS_CTR_COUNT
+};
+
+/**
+ * @brief Published LFIB entry
+ */
+typedef struct {
+    rcu_head_t rcu;
+    mpls_lfib_entry_t config;
+    uint8_t eth[MPLS_ETH_ADDRS_LEN];            /**< Next hop and egress port MACs */
+    uint32_t out_lse[MPLS_MAX_OUT_LABELS];      /**< Out labels shifted into place */
+} mpls_entry_t;
+
+/**
+ * @brief Label switching state
+ */
+static struct {
+    bool initialized;
+    spinlock_t lock;                /**< Serializes configuration */
+    uint32_t handle;                /**< Label switching stage */
+    uint32_t count;                 /**< Labels with an entry */
+    mpls_entry_t **lfib;            /**< CONFIG_MPLS_LABEL_SPACE published entries (RCU) */
+    stats_shard_set_t *counters;    /**< MPLS_CTR_COUNT counters */
+} g_mpls = {0};
+
+static inline uint32_t mpls_read32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static inline void mpls_write32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static inline void mpls_write16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void mpls_entry_free(rcu_head_t *head) {
+    mem_free(MEM_TAG_MPLS, head);
+}
+
+/**
+ * @brief Drop a frame, counting it
+ */
+static inline packet_result_t mpls_drop(packet_buffer_t *packet, uint64_t *ctr, uint32_t counter,
+                                        packet_drop_reason_t reason) {
+    stats_shard_add(&ctr[counter], 1);
+    packet_drop_count(packet, reason);
+    return PACKET_RESULT_DROP;
+}
+
+/**
+ * @brief Ethertype of the payload under the bottom of stack, 0 if unknown
+ */
+static inline uint16_t mpls_payload_type(const packet_buffer_t *packet, uint32_t offset) {
+    if (offset >= packet->size) {
+        return 0;
+    }
+    switch (packet->data[offset] >> 4) {
+        case 4: return MPLS_ETHERTYPE_IPV4;
+        case 6: return MPLS_ETHERTYPE_IPV6;
+        default: return 0;
+    }
+}
+
+/**
+ * @brief Pop a frame down to its IP payload and pass it on as an IP frame
+ *
+ * The received Ethernet header is kept, with the payload's ethertype.
+ *
+ * @param packet Frame
+ * @param payload Offset of the payload
+ * @param ctr Counters of this thread
+ * @return PACKET_RESULT_FORWARD, or PACKET_RESULT_DROP
+ */
+static packet_result_t mpls_terminate(packet_buffer_t *packet, uint32_t payload, uint64_t *ctr) {
+    uint32_t l2_len = packet->metadata.l3_offset;
+    uint32_t labels = payload - l2_len;
+    uint16_t ethertype = mpls_payload_type(packet, payload);
+
+    if (ethertype == 0) {
+        return mpls_drop(packet, ctr, MPLS_CTR_BAD_STACK, PACKET_DROP_MPLS_LABEL);
+    }
+    if (packet_make_writable(packet) != STATUS_SUCCESS) {
+        return mpls_drop(packet, ctr, MPLS_CTR_TX_DROPS, PACKET_DROP_INTERNAL);
+    }
+
+    // The L2 header moves onto the labels; what is left in front is pulled off
+    memmove(packet->data + labels, packet->data, l2_len);
+    mpls_write16(packet->data + labels + l2_len - 2, ethertype);
+    packet_pull_header(packet, labels, NULL);
+    packet_invalidate_parse(packet);
+    packet_parse(packet);
+
+    stats_shard_add(&ctr[MPLS_CTR_TERMINATED], 1);
+    return PACKET_RESULT_FORWARD;
+}
+
+/**
+ * @brief Rewrite a frame for the next hop of its entry
+ *
+ * @param packet Frame, parsed
+ * @param entry Entry of the top label
+ * @param top Offset of the top label; entries above it were popped
+ * @param lse Top label stack entry
+ * @param ctr Counters of this thread
+ * @param[out] tx_port Physical port to queue the frame on
+ * @return PACKET_RESULT_CONSUME if the frame is to be queued, or PACKET_RESULT_DROP
+ */
+static packet_result_t mpls_rewrite(packet_buffer_t *packet, const mpls_entry_t *entry, uint32_t top,
+                                    uint32_t lse, uint64_t *ctr, port_id_t *tx_port) {
+    uint32_t out[MPLS_MAX_OUT_LABELS + 1];
+    uint32_t tc_ttl = (lse & MPLS_LSE_TC_MASK) | ((lse & MPLS_LSE_TTL_MASK) - 1);
+    uint32_t consumed = top + MPLS_LSE_LEN;
+    uint32_t count = 0, hdr_len, counter;
+    uint16_t ethertype = ETHERTYPE_MPLS;
+    port_id_t port;
+    status_t status;
+    uint8_t *p;
+
+    switch (entry->config.action) {
+        case MPLS_ACTION_SWAP:
+            for (; count < entry->config.out_count; count++) {
+                out[count] = entry->out_lse[count] | tc_ttl;
+            }
+            out[count - 1] |= lse & MPLS_LSE_BOS;
+            counter = MPLS_CTR_SWAPPED;
+            break;
+        case MPLS_ACTION_PUSH:
+            for (; count < entry->config.out_count; count++) {
+                out[count] = entry->out_lse[count] | tc_ttl;
+            }
+            out[count++] = (lse & ~MPLS_LSE_TTL_MASK) | (tc_ttl & MPLS_LSE_TTL_MASK);
+            counter = MPLS_CTR_PUSHED;
+            break;
+        default:
+            // Penultimate hop: the next hop gets the rest of the stack or the payload
+            if (lse & MPLS_LSE_BOS) {
+                ethertype = mpls_payload_type(packet, consumed);
+                if (ethertype == 0) {
+                    return mpls_drop(packet, ctr, MPLS_CTR_BAD_STACK, PACKET_DROP_MPLS_LABEL);
+                }
+            }
+            counter = MPLS_CTR_POPPED;
+            break;
+    }
+
+    // The member is chosen on the stack as received
+    port = lag_egress_port(entry->config.egress_port, packet);
+    if (port == PORT_ID_INVALID) {
+        return mpls_drop(packet, ctr, MPLS_CTR_TX_DROPS, PACKET_DROP_PORT_DOWN);
+    }
+
+    hdr_len = MPLS_ETH_HLEN + count * MPLS_LSE_LEN;
+    if (hdr_len > consumed) {
+        status = packet_push_header(packet, hdr_len - consumed, NULL);
+    } else if (hdr_len < consumed) {
+        status = packet_pull_header(packet, consumed - hdr_len, NULL);
+    } else {
+        status = packet_make_writable(packet);
+    }
+    if (status != STATUS_SUCCESS) {
+        return mpls_drop(packet, ctr, MPLS_CTR_TX_DROPS, PACKET_DROP_INTERNAL);
+    }
+
+    p = packet->data;
+    memcpy(p, entry->eth, MPLS_ETH_ADDRS_LEN);
+    mpls_write16(p + MPLS_ETH_ADDRS_LEN, ethertype);
+    p += MPLS_ETH_HLEN;
+    for (uint32_t i = 0; i < count; i++, p += MPLS_LSE_LEN) {
+        mpls_write32(p, out[i]);
+    }
+    packet_invalidate_parse(packet);
+    packet->metadata.priority = (uint8_t)((lse & MPLS_LSE_TC_MASK) >> MPLS_LSE_TC_SHIFT);
+
+    stats_shard_add(&ctr[counter], 1);
+    *tx_port = port;
+    return PACKET_RESULT_CONSUME;
+}
+
+/**
+ * @brief Switch one labeled frame
+ *
+ * @param packet Frame, parsed, with PACKET_PROTO_MPLS
+ * @param ctr Counters of this thread
+ * @param[out] tx_port Port to queue the frame on, for PACKET_RESULT_CONSUME
+ * @return PACKET_RESULT_CONSUME to queue it, PACKET_RESULT_FORWARD for an
+ *         IP frame left after popping, or PACKET_RESULT_DROP
+ */
+static packet_result_t mpls_switch(packet_buffer_t *packet, uint64_t *ctr, port_id_t *tx_port) {
+    uint32_t pos = packet->metadata.l3_offset;
+    const mpls_entry_t *entry = NULL;
+    uint32_t lse, label;
+
+    if (packet->metadata.ethertype != ETHERTYPE_MPLS || !packet_parsed_has(packet, PACKET_PARSED_MPLS)) {
+        return mpls_drop(packet, ctr, MPLS_CTR_BAD_STACK, PACKET_DROP_MPLS_LABEL);
+    }
+
+    // Pops without a next hop walk down the stack, which the parser found complete
+    for (;;) {
+        lse = mpls_read32(packet->data + pos);
+        label = lse >> MPLS_LSE_LABEL_SHIFT;
+        if (label <= MPLS_LABEL_RESERVED_MAX) {
+            if (label != MPLS_LABEL_IPV4_NULL && label != MPLS_LABEL_IPV6_NULL) {
+                return mpls_drop(packet, ctr, MPLS_CTR_RESERVED_LABEL, PACKET_DROP_MPLS_LABEL);
+            }
+        } else {
+            entry = label < CONFIG_MPLS_LABEL_SPACE ?
+                    __atomic_load_n(&g_mpls.lfib[label], __ATOMIC_ACQUIRE) : NULL;
+            if (!entry) {
+                return mpls_drop(packet, ctr, MPLS_CTR_UNKNOWN_LABEL, PACKET_DROP_MPLS_LABEL);
+            }
+            if (entry->config.action != MPLS_ACTION_POP || entry->config.egress_port != PORT_ID_INVALID) {
+                break;
+            }
+        }
+        pos += MPLS_LSE_LEN;
+        if (lse & MPLS_LSE_BOS) {
+            return mpls_terminate(packet, pos, ctr);
+        }
+    }
+
+    if ((lse & MPLS_LSE_TTL_MASK) <= 1) {
+        return mpls_drop(packet, ctr, MPLS_CTR_TTL_EXPIRED, PACKET_DROP_TTL_EXCEEDED);
+    }
+    return mpls_rewrite(packet, entry, pos, lse, ctr, tx_port);
+}
+
+/**
+ * @brief Label switching stage
+ *
+ * Frames are rewritten one by one, then queued on their egress ports in
+ * one ring operation per port.
+ */
+static void mpls_switch_burst(packet_buffer_t **pkts, uint32_t count, packet_result_t *results,
+                              void *user_data) {
+    port_id_t tx_port[PACKET_BURST_MAX];
+    packet_buffer_t *batch[PACKET_BURST_MAX];
+    uint64_t *ctr = NULL;
+    uint32_t pending = 0;
+
+    (void)user_data;
+    for (uint32_t i = 0; i < count; i++) {
+        results[i] = PACKET_RESULT_FORWARD;
+        tx_port[i] = PORT_ID_INVALID;
+        if (packet_ensure_parsed(pkts[i]) != STATUS_SUCCESS || !packet_has_proto(pkts[i], PACKET_PROTO_MPLS)) {
+            continue;
+        }
+        if (!ctr) {
+            ctr = stats_shard_local(g_mpls.counters);
+            if (!ctr || rcu_read_lock() != STATUS_SUCCESS) {
+                ctr = NULL;
+                return;
+            }
+        }
+        results[i] = mpls_switch(pkts[i], ctr, &tx_port[i]);
+        pending += results[i] == PACKET_RESULT_CONSUME;
+    }
+    if (!ctr) {
+        return;
+    }
+    rcu_read_unlock();
+
+    for (uint32_t i = 0; pending > 0 && i < count; i++) {
+        port_id_t port = tx_port[i];
+        uint32_t n = 0, queued;
+
+        if (port == PORT_ID_INVALID) {
+            continue;
+        }
+        for (uint32_t j = i; j < count; j++) {
+            if (tx_port[j] == port) {
+                batch[n++] = pkts[j];
+                tx_port[j] = PORT_ID_INVALID;
+            }
+        }
+        pending -= n;
+
+        // The ring owns what it took and counted what it refused
+        queued = hw_sim_tx_enqueue_burst(port, batch, n);
+        for (uint32_t j = queued; j < n; j++) {
+            packet_drop_count(batch[j], PACKET_DROP_TX_RING_FULL);
+            packet_buffer_free(batch[j]);
+        }
+        stats_shard_add(&ctr[MPLS_CTR_TX_DROPS], n - queued);
+    }
+}
+
+/**
+ * @brief Allocate the LFIB and register the label switching stage
+ *
+ * @return status_t Status code
+ */
+status_t mpls_init(void) {
+    status_t status;
+
+    if (g_mpls.initialized) {
+        LOG_WARNING(LOG_CATEGORY_L3, "MPLS: Already initialized");
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    // Zeroed pages: only labels in use are ever backed by memory
+    g_mpls.lfib = mem_calloc(MEM_TAG_MPLS, CONFIG_MPLS_LABEL_SPACE, sizeof(*g_mpls.lfib));
+    if (!g_mpls.lfib) {
+        LOG_ERROR(LOG_CATEGORY_L3, "MPLS: Failed to allocate the LFIB");
+        return STATUS_NO_MEMORY;
+    }
+    status = stats_shard_create(MPLS_CTR_COUNT, &g_mpls.counters);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "MPLS: Failed to create counters");
+        mem_free(MEM_TAG_MPLS, g_mpls.lfib);
+        g_mpls.lfib = NULL;
+        return status;
+    }
+
+    spinlock_init(&g_mpls.lock);
+    g_mpls.count = 0;
+    __atomic_store_n(&g_mpls.initialized, true, __ATOMIC_RELEASE);
+
+    status = packet_register_burst_processor(mpls_switch_burst, MPLS_PROCESSOR_PRIORITY, NULL,
+                                             &g_mpls.handle);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "MPLS: Failed to register the label switching stage: %d", status);
+        __atomic_store_n(&g_mpls.initialized, false, __ATOMIC_RELEASE);
+        stats_shard_destroy(g_mpls.counters);
+        g_mpls.counters = NULL;
+        mem_free(MEM_TAG_MPLS, g_mpls.lfib);
+        g_mpls.lfib = NULL;
+        return status;
+    }
+    packet_set_processor_name(g_mpls.handle, "mpls");
+
+    LOG_INFO(LOG_CATEGORY_L3, "MPLS: Module initialized, %u labels", (uint32_t)CONFIG_MPLS_LABEL_SPACE);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Unregister the stage and free the LFIB
+ *
+ * @return status_t Status code
+ */
+status_t mpls_cleanup(void) {
+    if (!g_mpls.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    packet_unregister_processor(g_mpls.handle);
+    __atomic_store_n(&g_mpls.initialized, false, __ATOMIC_RELEASE);
+    rcu_synchronize();
+
+    for (uint32_t label = 0; g_mpls.count > 0 && label < CONFIG_MPLS_LABEL_SPACE; label++) {
+        if (g_mpls.lfib[label]) {
+            mem_free(MEM_TAG_MPLS, g_mpls.lfib[label]);
+            g_mpls.count--;
+        }
+    }
+    mem_free(MEM_TAG_MPLS, g_mpls.lfib);
+    g_mpls.lfib = NULL;
+    stats_shard_destroy(g_mpls.counters);
+    g_mpls.counters = NULL;
+
+    LOG_INFO(LOG_CATEGORY_L3, "MPLS: Module cleaned up");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Install or replace the entry of an incoming label
+ *
+ * @param label Incoming label
+ * @param entry Action and next hop
+ * @return status_t Status code
+ */
+status_t mpls_lfib_set(uint32_t label, const mpls_lfib_entry_t *entry) {
+    mpls_entry_t *new_entry, *old;
+    mac_addr_t src;
+    bool valid;
+
+    if (!g_mpls.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!entry || label <= MPLS_LABEL_RESERVED_MAX || label >= CONFIG_MPLS_LABEL_SPACE) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    switch (entry->action) {
+        case MPLS_ACTION_SWAP:
+        case MPLS_ACTION_PUSH:
+            valid = entry->out_count >= 1 && entry->out_count <= MPLS_MAX_OUT_LABELS &&
+                    entry->egress_port < CONFIG_MAX_PORTS;
+            for (uint32_t i = 0; valid && i < entry->out_count; i++) {
+                // Implicit null means pop, which has its own action
+                valid = entry->out_labels[i] <= MPLS_LABEL_MAX &&
+                        entry->out_labels[i] != MPLS_LABEL_IMPLICIT_NULL;
+            }
+            break;
+        case MPLS_ACTION_POP:
+            valid = entry->out_count == 0 &&
+                    (entry->egress_port < CONFIG_MAX_PORTS || entry->egress_port == PORT_ID_INVALID);
+            break;
+        default:
+            valid = false;
+            break;
+    }
+    if (!valid) {
+        LOG_ERROR(LOG_CATEGORY_L3, "MPLS: Invalid entry for label %u", label);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(&src, 0, sizeof(src));
+    if (entry->egress_port != PORT_ID_INVALID && port_get_mac(entry->egress_port, &src) != STATUS_SUCCESS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    new_entry = mem_calloc(MEM_TAG_MPLS, 1, sizeof(*new_entry));
+    if (!new_entry) {
+        return STATUS_NO_MEMORY;
+    }
+    new_entry->config = *entry;
+    memcpy(new_entry->eth, entry->next_hop_mac.addr, MAC_ADDR_LEN);
+    memcpy(new_entry->eth + MAC_ADDR_LEN, src.addr, MAC_ADDR_LEN);
+    for (uint32_t i = 0; i < entry->out_count; i++) {
+        new_entry->out_lse[i] = entry->out_labels[i] << MPLS_LSE_LABEL_SHIFT;
+    }
+
+    spinlock_acquire(&g_mpls.lock);
+    old = __atomic_exchange_n(&g_mpls.lfib[label], new_entry, __ATOMIC_ACQ_REL);
+    if (!old) {
+        g_mpls.count++;
+    }
+    spinlock_release(&g_mpls.lock);
+
+    if (old) {
+        rcu_retire(&old->rcu, mpls_entry_free);
+    }
+    LOG_DEBUG(LOG_CATEGORY_L3, "MPLS: Label %u %s, action %d to port %u", label,
+              old ? "replaced" : "installed", entry->action, entry->egress_port);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Remove the entry of an incoming label
+ *
+ * @param label Incoming label
+ * @return status_t Status code
+ */
+status_t mpls_lfib_delete(uint32_t label) {
+    mpls_entry_t *old;
+
+    if (!g_mpls.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (label >= CONFIG_MPLS_LABEL_SPACE) {
+        return STATUS_NOT_FOUND;
+    }
+
+    spinlock_acquire(&g_mpls.lock);
+    old = __atomic_exchange_n(&g_mpls.lfib[label], NULL, __ATOMIC_ACQ_REL);
+    if (old) {
+        g_mpls.count--;
+    }
+    spinlock_release(&g_mpls.lock);
+
+    if (!old) {
+        return STATUS_NOT_FOUND;
+    }
+    rcu_retire(&old->rcu, mpls_entry_free);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the entry of an incoming label
+ *
+ * @param label Incoming label
+ * @param entry Action and next hop
+ * @return status_t Status code
+ */
+status_t mpls_lfib_get(uint32_t label, mpls_lfib_entry_t *entry) {
+    status_t status = STATUS_NOT_FOUND;
+
+    if (!g_mpls.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!entry || label >= CONFIG_MPLS_LABEL_SPACE) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_mpls.lock);
+    if (g_mpls.lfib[label]) {
+        *entry = g_mpls.lfib[label]->config;
+        status = STATUS_SUCCESS;
+    }
+    spinlock_release(&g_mpls.lock);
+    return status;
+}
+
+/**
+ * @brief Number of labels with an entry
+ *
+ * @return uint32_t Entries installed
+ */
+uint32_t mpls_lfib_count(void) {
+    if (!g_mpls.initialized) {
+        return 0;
+    }
+    return __atomic_load_n(&g_mpls.count, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Get the label switching counters
+ *
+ * @param stats Counters
+ * @return status_t Status code
+ */
+status_t mpls_get_stats(mpls_stats_t *stats) {
+    uint64_t ctr[MPLS_CTR_COUNT];
+
+    if (!g_mpls.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    stats_shard_fold(g_mpls.counters, 0, MPLS_CTR_COUNT, ctr);
+    stats->swapped = ctr[MPLS_CTR_SWAPPED];
+    stats->pushed = ctr[MPLS_CTR_PUSHED];
+    stats->popped = ctr[MPLS_CTR_POPPED];
+    stats->terminated = ctr[MPLS_CTR_TERMINATED];
+    stats->unknown_label = ctr[MPLS_CTR_UNKNOWN_LABEL];
+    stats->reserved_label = ctr[MPLS_CTR_RESERVED_LABEL];
+    stats->bad_stack = ctr[MPLS_CTR_BAD_STACK];
+    stats->ttl_expired = ctr[MPLS_CTR_TTL_EXPIRED];
+    stats->tx_drops = ctr[MPLS_CTR_TX_DROPS];
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,467 @@
+/**
+ * @file punt.c
+ * @brief Implementation of the control-plane punt path
+ *
+ * Every protocol class has a GCRA policer like the ICMP error limiter, one
+ * theoretical arrival time updated with a compare-and-swap, and a packet
+ * ring whose producers are serialized by a spinlock. A packet refused by
+ * the policer costs the worker nothing more; an accepted one costs a
+ * shared clone of its descriptor. The punt thread drains the classes in
+ * turn, at most PUNT_DRAIN_BATCH packets each, so one busy class cannot
+ * hold the others back. While a CPU trap ring is open every drained batch
+ * is also copied into it, after the class handler has seen it.
+ */
+
+#define _GNU_SOURCE
+#include "l3/punt.h"
+#include "l3/arp.h"
+#include "common/logging.h"
+#include "common/error_codes.h"
+#include "common/rcu.h"
+#include "common/threading.h"
+#include "hal/cpu_trap.h"
+#include "hal/packet.h"
+#include "hal/packet_ring.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Defines */
+#define PUNT_NS_PER_SEC 1000000000ULL
+#define PUNT_CACHE_LINE 64
+
+#define PUNT_STAT_INC(q, field) __atomic_fetch_add(&(q)->stats.field, 1, __ATOMIC_RELAXED)
+#define PUNT_STAT_ADD(q, field, n) __atomic_fetch_add(&(q)->stats.field, (n), __ATOMIC_RELAXED)
+
+/* Private data types */
+
+/* Policer, queue and handler of one class */
+typedef struct {
+    uint64_t tat __attribute__((aligned(PUNT_CACHE_LINE))); /* Theoretical arrival time of the policer */
+    uint64_t interval_ns;           /* Time one packet costs, 0 if the class is dropped */
+    uint64_t depth_ns;              /* Burst a quiet class may spend at once */
+    uint32_t queue_limit;           /* Packets the queue may hold */
+    spinlock_t queue_lock;          /* Serializes the workers producing into the queue */
+    packet_ring_t *queue;           /* Packets waiting for the punt thread */
+    punt_handler_t handler;         /* Protected by the handler lock */
+    void *ctx;
+    punt_stats_t stats;
+} punt_queue_t;
+
+/* Punt path state */
+typedef struct {
+    bool initialized;
+    volatile bool stop;
+    pthread_t thread;
+    uint32_t stage_handle;          /* ARP punt stage, UINT32_MAX if not registered */
+    spinlock_t handler_lock;
+    punt_queue_t queues[PUNT_CLASS_COUNT];
+} punt_engine_t;
+
+/* Default settings of each class */
+static const punt_policer_t g_punt_defaults[PUNT_CLASS_COUNT] = {
+    [PUNT_CLASS_ARP]   = { .rate = 2000, .burst = 200, .queue_limit = PUNT_QUEUE_SIZE },
+    [PUNT_CLASS_ICMP]  = { .rate = 1000, .burst = 100, .queue_limit = PUNT_QUEUE_SIZE / 2 },
+    [PUNT_CLASS_IGMP]  = { .rate = 500,  .burst = 50,  .queue_limit = PUNT_QUEUE_SIZE / 4 },
+    [PUNT_CLASS_OSPF]  = { .rate = 2000, .burst = 200, .queue_limit = PUNT_QUEUE_SIZE },
+    [PUNT_CLASS_RIP]   = { .rate = 500,  .burst = 50,  .queue_limit = PUNT_QUEUE_SIZE / 4 },
+    [PUNT_CLASS_BFD]   = { .rate = 200000, .burst = 4000, .queue_limit = PUNT_QUEUE_SIZE },
+    [PUNT_CLASS_OTHER] = { .rate = 1000, .burst = 100, .queue_limit = PUNT_QUEUE_SIZE / 2 },
+};
+
+/* Trap reason recorded for each class on the CPU trap ring */
+static const cpu_trap_reason_t g_punt_trap_reasons[PUNT_CLASS_COUNT] = {
+    [PUNT_CLASS_ARP]   = CPU_TRAP_REASON_ARP,
+    [PUNT_CLASS_ICMP]  = CPU_TRAP_REASON_ICMP,
+    [PUNT_CLASS_IGMP]  = CPU_TRAP_REASON_IGMP,
+    [PUNT_CLASS_OSPF]  = CPU_TRAP_REASON_OSPF,
+    [PUNT_CLASS_RIP]   = CPU_TRAP_REASON_RIP,
+    [PUNT_CLASS_BFD]   = CPU_TRAP_REASON_LOCAL,
+    [PUNT_CLASS_OTHER] = CPU_TRAP_REASON_LOCAL,
+};
+
+/* Global variables */
+static punt_engine_t g_punt = { .stage_handle = UINT32_MAX };
+
+/* Forward declarations of private functions */
+static uint64_t punt_now_ns(void);
+static bool punt_police(punt_queue_t *q, uint64_t now);
+static uint32_t punt_drain(void);
+static void punt_drop_all(void);
+static void *punt_thread_main(void *arg);
+static void punt_arp_handler(packet_buffer_t **packets, uint32_t count, void *ctx);
+static void punt_arp_stage(packet_buffer_t **pkts, uint32_t count, packet_result_t *results, void *user_data);
+
+/**
+ * @brief Create the class queues and start the punt thread
+ *
+ * @return STATUS_SUCCESS on success, appropriate error code otherwise
+ */
+status_t punt_init(void) {
+    if (g_punt.initialized) {
+        return STATUS_SUCCESS;
+    }
+
+    memset(&g_punt, 0, sizeof(g_punt));
+    g_punt.stage_handle = UINT32_MAX;
+    spinlock_init(&g_punt.handler_lock);
+
+    for (uint32_t i = 0; i < PUNT_CLASS_COUNT; i++) {
+        punt_queue_t *q = &g_punt.queues[i];
+        q->queue = packet_ring_create(PUNT_QUEUE_SIZE);
+        if (!q->queue) {
+            LOG_ERROR(LOG_CATEGORY_L3, "Failed to allocate punt queue %u", i);
+            for (uint32_t j = 0; j < i; j++) {
+                packet_ring_destroy(g_punt.queues[j].queue);
+                g_punt.queues[j].queue = NULL;
+            }
+            return ERROR_OUT_OF_MEMORY;
+        }
+        spinlock_init(&q->queue_lock);
+    }
+
+    g_punt.initialized = true;
+    for (uint32_t i = 0; i < PUNT_CLASS_COUNT; i++) {
+        punt_set_policer((punt_class_t)i, &g_punt_defaults[i]);
+    }
+    punt_set_handler(PUNT_CLASS_ARP, punt_arp_handler, NULL);
+
+    if (pthread_create(&g_punt.thread, NULL, punt_thread_main, NULL) != 0) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to start punt thread");
+        g_punt.initialized = false;
+        for (uint32_t i = 0; i < PUNT_CLASS_COUNT; i++) {
+            packet_ring_destroy(g_punt.queues[i].queue);
+            g_punt.queues[i].queue = NULL;
+        }
+        return STATUS_FAILURE;
+    }
+    pthread_setname_np(g_punt.thread, "cpu-punt");
+
+    /* ARP goes to the control plane and on through the bridge */
+    if (packet_register_burst_processor(punt_arp_stage, PUNT_PROCESSOR_PRIORITY,
+                                        NULL, &g_punt.stage_handle) != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_L3, "Packet pipeline not available, ARP punt stage not registered");
+        g_punt.stage_handle = UINT32_MAX;
+    } else {
+        packet_set_processor_name(g_punt.stage_handle, "arp-punt");
+    }
+
+    LOG_INFO(LOG_CATEGORY_L3, "Punt path initialized");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Stop the punt thread and drop everything still queued
+ *
+ * @return STATUS_SUCCESS on success
+ */
+status_t punt_shutdown(void) {
+    if (!g_punt.initialized) {
+        return STATUS_SUCCESS;
+    }
+
+    if (g_punt.stage_handle != UINT32_MAX) {
+        packet_unregister_processor(g_punt.stage_handle);
+        g_punt.stage_handle = UINT32_MAX;
+        rcu_synchronize();
+    }
+
+    g_punt.stop = true;
+    pthread_join(g_punt.thread, NULL);
+    g_punt.initialized = false;
+
+    punt_drop_all();
+    for (uint32_t i = 0; i < PUNT_CLASS_COUNT; i++) {
+        packet_ring_destroy(g_punt.queues[i].queue);
+        g_punt.queues[i].queue = NULL;
+    }
+
+    LOG_INFO(LOG_CATEGORY_L3, "Punt path shut down");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the default settings of a class
+ *
+ * @param cls Protocol class
+ * @param[out] policer Settings
+ * @return STATUS_SUCCESS on success, ERROR_INVALID_PARAMETER on a bad class
+ */
+status_t punt_get_default_policer(punt_class_t cls, punt_policer_t *policer) {
+    if ((uint32_t)cls >= PUNT_CLASS_COUNT || !policer) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    *policer = g_punt_defaults[cls];
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Change the policer and queue limit of a class
+ *
+ * @param cls Protocol class
+ * @param policer New settings
+ * @return STATUS_SUCCESS on success, ERROR_INVALID_PARAMETER on bad settings
+ */
+status_t punt_set_policer(punt_class_t cls, const punt_policer_t *policer) {
+    if (!g_punt.initialized) {
+        return ERROR_NOT_INITIALIZED;
+    }
+    if ((uint32_t)cls >= PUNT_CLASS_COUNT || !policer ||
+        policer->burst == 0 || policer->burst > UINT16_MAX ||
+        policer->queue_limit == 0 || policer->queue_limit > PUNT_QUEUE_SIZE) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    punt_queue_t *q = &g_punt.queues[cls];
+    uint64_t interval = policer->rate ? PUNT_NS_PER_SEC / policer->rate : 0;
+    __atomic_store_n(&q->interval_ns, interval, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->depth_ns, (uint64_t)policer->burst * interval, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->queue_limit, policer->queue_limit, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->tat, 0, __ATOMIC_RELAXED);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Set the protocol handler of a class
+ *
+ * @param cls Protocol class
+ * @param handler Handler, NULL to drop the class's packets after policing
+ * @param ctx Passed to the handler
+ * @return STATUS_SUCCESS on success, ERROR_INVALID_PARAMETER on a bad class
+ */
+status_t punt_set_handler(punt_class_t cls, punt_handler_t handler, void *ctx) {
+    if (!g_punt.initialized) {
+        return ERROR_NOT_INITIALIZED;
+    }
+    if ((uint32_t)cls >= PUNT_CLASS_COUNT) {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_punt.handler_lock);
+    g_punt.queues[cls].handler = handler;
+    g_punt.queues[cls].ctx = ctx;
+    spinlock_release(&g_punt.handler_lock);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Queue a packet for the control plane
+ *
+ * Runs on the forwarding worker: the policer is charged before anything
+ * is allocated, so a flood over the rate never reaches the queue.
+ *
+ * @param packet Packet to punt
+ * @param cls Protocol class
+ * @return STATUS_SUCCESS if the packet was queued, appropriate error code otherwise
+ */
+status_t punt_packet(const packet_buffer_t *packet, punt_class_t cls) {
+    if (!packet || (uint32_t)cls >= PUNT_CLASS_COUNT) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    if (!g_punt.initialized) {
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    punt_queue_t *q = &g_punt.queues[cls];
+    if (!punt_police(q, punt_now_ns())) {
+        PUNT_STAT_INC(q, policed);
+        return ERROR_PUNT_POLICED;
+    }
+
+    /* An early look spares the clone when the queue is plainly full */
+    uint32_t limit = __atomic_load_n(&q->queue_limit, __ATOMIC_RELAXED);
+    if (packet_ring_count(q->queue) >= limit) {
+        PUNT_STAT_INC(q, queue_drops);
+        return STATUS_RESOURCE_EXCEEDED;
+    }
+
+    packet_buffer_t *ref = packet_buffer_clone_shared(packet);
+    if (!ref) {
+        PUNT_STAT_INC(q, queue_drops);
+        return ERROR_PACKET_ALLOCATION_FAILED;
+    }
+
+    uint32_t queued = 0;
+    spinlock_acquire(&q->queue_lock);
+    if (packet_ring_count(q->queue) < limit) {
+        queued = packet_ring_enqueue_burst(q->queue, &ref, 1);
+    }
+    spinlock_release(&q->queue_lock);
+
+    if (queued == 0) {
+        packet_buffer_free(ref);
+        PUNT_STAT_INC(q, queue_drops);
+        return STATUS_RESOURCE_EXCEEDED;
+    }
+
+    PUNT_STAT_INC(q, punted);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the punt statistics of a class
+ *
+ * @param cls Protocol class
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, ERROR_INVALID_PARAMETER on bad arguments
+ */
+status_t punt_get_stats(punt_class_t cls, punt_stats_t *stats) {
+    if ((uint32_t)cls >= PUNT_CLASS_COUNT || !stats) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    if (!g_punt.initialized) {
+        return ERROR_NOT_INITIALIZED;
+    }
+
+    punt_queue_t *q = &g_punt.queues[cls];
+    stats->punted = __atomic_load_n(&q->stats.punted, __ATOMIC_RELAXED);
+    stats->policed = __atomic_load_n(&q->stats.policed, __ATOMIC_RELAXED);
+    stats->queue_drops = __atomic_load_n(&q->stats.queue_drops, __ATOMIC_RELAXED);
+    stats->delivered = __atomic_load_n(&q->stats.delivered, __ATOMIC_RELAXED);
+    stats->unhandled = __atomic_load_n(&q->stats.unhandled, __ATOMIC_RELAXED);
+    stats->depth = packet_ring_count(q->queue);
+    return STATUS_SUCCESS;
+}
+
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/**
+ * @brief Current monotonic time in nanoseconds
+ */
+static uint64_t punt_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * PUNT_NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Charge one packet to the policer of a class
+ *
+ * @param q Class
+ * @param now Current time (ns)
+ * @return true if the packet conforms
+ */
+static bool punt_police(punt_queue_t *q, uint64_t now) {
+    uint64_t interval = __atomic_load_n(&q->interval_ns, __ATOMIC_RELAXED);
+    uint64_t depth = __atomic_load_n(&q->depth_ns, __ATOMIC_RELAXED);
+    uint64_t tat = __atomic_load_n(&q->tat, __ATOMIC_RELAXED);
+
+    if (interval == 0) {
+        return false;
+    }
+
+    for (;;) {
+        uint64_t next = (tat > now ? tat : now) + interval;
+        if (next - now > depth) {
+            return false;
+        }
+        if (__atomic_compare_exchange_n(&q->tat, &tat, next, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return true;
+        }
+    }
+}
+
+/**
+ * @brief Hand one batch of every class to its handler (punt thread only)
+ *
+ * @return Number of packets taken from the queues
+ */
+static uint32_t punt_drain(void) {
+    packet_buffer_t *pkts[PUNT_DRAIN_BATCH];
+    uint32_t total = 0;
+
+    for (uint32_t i = 0; i < PUNT_CLASS_COUNT; i++) {
+        punt_queue_t *q = &g_punt.queues[i];
+        uint32_t n = packet_ring_dequeue_burst(q->queue, pkts, PUNT_DRAIN_BATCH);
+        if (n == 0) {
+            continue;
+        }
+
+        spinlock_acquire(&g_punt.handler_lock);
+        punt_handler_t handler = q->handler;
+        void *ctx = q->ctx;
+        spinlock_release(&g_punt.handler_lock);
+
+        if (handler) {
+            handler(pkts, n, ctx);
+            PUNT_STAT_ADD(q, delivered, n);
+        } else {
+            PUNT_STAT_ADD(q, unhandled, n);
+        }
+        if (cpu_trap_enabled()) {
+            cpu_trap_submit(pkts, n, g_punt_trap_reasons[i]);
+        }
+        for (uint32_t j = 0; j < n; j++) {
+            packet_buffer_free(pkts[j]);
+        }
+        total += n;
+    }
+
+    return total;
+}
+
+/**
+ * @brief Free every queued packet without handling it
+ */
+static void punt_drop_all(void) {
+    packet_buffer_t *pkts[PUNT_DRAIN_BATCH];
+
+    for (uint32_t i = 0; i < PUNT_CLASS_COUNT; i++) {
+        uint32_t n;
+        while ((n = packet_ring_dequeue_burst(g_punt.queues[i].queue, pkts, PUNT_DRAIN_BATCH)) > 0) {
+            for (uint32_t j = 0; j < n; j++) {
+                packet_buffer_free(pkts[j]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Punt thread: drain the class queues until stopped
+ */
+static void *punt_thread_main(void *arg) {
+    (void)arg;
+
+    while (!g_punt.stop) {
+        if (punt_drain() == 0) {
+            usleep(PUNT_IDLE_SLEEP_US);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Default ARP handler: learn the senders and answer requests
+ */
+static void punt_arp_handler(packet_buffer_t **packets, uint32_t count, void *ctx) {
+    (void)ctx;
+
+    status_t status = arp_handle_frames_bulk(packets, count);
+    if (status != STATUS_SUCCESS) {
+        LOG_DEBUG(LOG_CATEGORY_L3, "Punted ARP frames not all processed: error=%d", status);
+    }
+}
+
+/**
+ * @brief Pipeline stage punting ARP frames
+ *
+ * Every packet is forwarded; ARP frames are also queued for the control
+ * plane, as long as their class conforms.
+ */
+static void punt_arp_stage(packet_buffer_t **pkts, uint32_t count, packet_result_t *results, void *user_data) {
+    (void)user_data;
+
+    for (uint32_t i = 0; i < count; i++) {
+        packet_buffer_t *packet = pkts[i];
+        results[i] = PACKET_RESULT_FORWARD;
+        if (packet_ensure_parsed(packet) == STATUS_SUCCESS &&
+            packet_parsed_has(packet, PACKET_PARSED_L2) &&
+            packet->metadata.ethertype == ETHERTYPE_ARP) {
+            punt_packet(packet, PUNT_CLASS_ARP);
+        }
+    }
+}
@@ -0,0 +1,599 @@
+/**
+ * @file route_loader.c
+ * @brief Implementation of bulk routing table loads and dumps
+ *
+ * The file is mapped read-only. Route images have fixed-size records and
+ * are split by record number; MRT files are split after a pass over the
+ * record headers, which reads 12 bytes per record and skips the rest.
+ * Each parser thread turns its slice into an array of routes. The calling
+ * thread joins the parsers in file order and hands each array to the
+ * routing table in one call, under one lock hold, while the parsers of
+ * later slices keep running; RIB updates themselves stay single-writer.
+ */
+
+#include "l3/route_loader.h"
+#include "common/logging.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Defines */
+#define LOADER_MIN_SLICE_ROUTES     16384   /* Fewer routes per thread are not worth one */
+#define LOADER_DEFAULT_THREADS      4       /* If the CPU count is unknown */
+
+/* MRT (RFC 6396) */
+#define MRT_HEADER_LEN              12
+#define MRT_TYPE_TABLE_DUMP_V2      13
+#define MRT_SUBTYPE_RIB_IPV4_UNICAST 2
+#define MRT_SUBTYPE_RIB_IPV6_UNICAST 4
+
+/* BGP path attributes read from RIB entries */
+#define BGP_ATTR_FLAG_EXTENDED      0x10
+#define BGP_ATTR_NEXT_HOP           3
+#define BGP_ATTR_MED                4
+#define BGP_ATTR_MP_REACH_NLRI      14
+
+/* Private data types */
+
+/* Byte range of the mapped file parsed by one thread */
+typedef struct {
+    const route_loader_options_t *options;
+    const uint8_t *begin;
+    const uint8_t *end;
+    route_loader_format_t format;
+    uint32_t capacity;              /* Records in the slice */
+    routing_route_t *routes;
+    uint32_t count;
+    uint32_t skipped;
+    uint32_t malformed;
+    pthread_t thread;
+    bool started;
+} loader_slice_t;
+
+/* Open route image being written */
+typedef struct {
+    FILE *file;
+    uint32_t count;
+    bool error;
+} loader_dump_t;
+
+/* Forward declarations of private functions */
+static uint64_t loader_now_us(void);
+static uint32_t loader_thread_count(const route_loader_options_t *options, uint64_t records);
+static void *loader_parse_slice(void *arg);
+static void loader_parse_mrt(loader_slice_t *slice);
+static void loader_parse_image(loader_slice_t *slice);
+static bool loader_parse_rib_entries(const uint8_t *p, const uint8_t *end, ip_addr_type_t type,
+                                     uint16_t peer_index, routing_route_t *route);
+static void loader_dump_route(const routing_route_t *route, void *ctx);
+static uint16_t loader_get16(const uint8_t *p);
+static uint32_t loader_get32(const uint8_t *p);
+static void loader_put16(uint8_t *p, uint16_t v);
+static void loader_put32(uint8_t *p, uint32_t v);
+
+/**
+ * @brief Get the default load parameters
+ *
+ * @param[out] options Parameters
+ */
+void route_loader_get_default_options(route_loader_options_t *options) {
+    if (!options) {
+        return;
+    }
+
+    memset(options, 0, sizeof(*options));
+    options->format = ROUTE_LOADER_FORMAT_AUTO;
+    options->source = ROUTE_TYPE_STATIC;
+    options->peer_index = ROUTE_LOADER_ANY_PEER;
+}
+
+/**
+ * @brief Load a route file into the routing table
+ *
+ * @param path File to load
+ * @param options Parameters, NULL for the defaults
+ * @param[out] stats Results, may be NULL
+ * @return STATUS_SUCCESS on success, error code otherwise
+ */
+status_t route_loader_load(const char *path, const route_loader_options_t *options,
+                           route_loader_stats_t *stats) {
+    route_loader_options_t defaults;
+    route_loader_stats_t result;
+    loader_slice_t slices[ROUTE_LOADER_MAX_THREADS];
+    status_t status = STATUS_SUCCESS;
+    struct stat st;
+    uint64_t start_us = loader_now_us();
+    bool own_batch = false;
+
+    if (!path) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (!options) {
+        route_loader_get_default_options(&defaults);
+        options = &defaults;
+    }
+    memset(&result, 0, sizeof(result));
+    memset(slices, 0, sizeof(slices));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Cannot open route file %s", path);
+        return STATUS_NOT_FOUND;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        LOG_ERROR(LOG_CATEGORY_L3, "Route file %s is empty", path);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    size_t size = (size_t)st.st_size;
+    const uint8_t *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Cannot map route file %s", path);
+        return STATUS_NO_MEMORY;
+    }
+    (void)madvise((void *)base, size, MADV_WILLNEED);
+    const uint8_t *end = base + size;
+
+    route_loader_format_t format = options->format;
+    if (format == ROUTE_LOADER_FORMAT_AUTO) {
+        format = (size >= ROUTE_LOADER_IMAGE_HEADER_LEN && memcmp(base, ROUTE_LOADER_IMAGE_MAGIC, 4) == 0) ?
+                 ROUTE_LOADER_FORMAT_IMAGE : ROUTE_LOADER_FORMAT_MRT;
+    }
+
+    uint32_t threads;
+    if (format == ROUTE_LOADER_FORMAT_IMAGE) {
+        if (size < ROUTE_LOADER_IMAGE_HEADER_LEN || memcmp(base, ROUTE_LOADER_IMAGE_MAGIC, 4) != 0 ||
+            loader_get16(base + 4) != ROUTE_LOADER_IMAGE_VERSION ||
+            loader_get16(base + 6) != ROUTE_LOADER_IMAGE_RECORD_LEN) {
+            munmap((void *)base, size);
+            LOG_ERROR(LOG_CATEGORY_L3, "%s is not a route image", path);
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        uint64_t records = loader_get32(base + 8);
+        uint64_t present = (size - ROUTE_LOADER_IMAGE_HEADER_LEN) / ROUTE_LOADER_IMAGE_RECORD_LEN;
+        if (present < records) {
+            LOG_WARNING(LOG_CATEGORY_L3, "Route image %s truncated: %llu of %llu routes",
+                        path, (unsigned long long)present, (unsigned long long)records);
+            records = present;
+        }
+        result.records = records;
+
+        threads = loader_thread_count(options, records);
+        const uint8_t *first = base + ROUTE_LOADER_IMAGE_HEADER_LEN;
+        for (uint32_t i = 0; i < threads; i++) {
+            uint64_t from = records * i / threads;
+            uint64_t to = records * (i + 1) / threads;
+            slices[i].begin = first + from * ROUTE_LOADER_IMAGE_RECORD_LEN;
+            slices[i].end = first + to * ROUTE_LOADER_IMAGE_RECORD_LEN;
+            slices[i].capacity = (uint32_t)(to - from);
+        }
+    } else {
+        /* Header pass: count the records, then cut at the record nearest each share */
+        uint64_t records = 0;
+        const uint8_t *p = base;
+        while (end - p >= MRT_HEADER_LEN && (uint64_t)(end - p - MRT_HEADER_LEN) >= loader_get32(p + 8)) {
+            p += MRT_HEADER_LEN + loader_get32(p + 8);
+            records++;
+        }
+        if (p != end) {
+            LOG_WARNING(LOG_CATEGORY_L3, "MRT file %s truncated after %llu records",
+                        path, (unsigned long long)records);
+            result.malformed++;
+        }
+        result.records = records;
+        end = p;
+
+        threads = loader_thread_count(options, records);
+        p = base;
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < threads; i++) {
+            uint64_t to = records * (i + 1) / threads;
+            slices[i].begin = p;
+            while (seen < to) {
+                p += MRT_HEADER_LEN + loader_get32(p + 8);
+                seen++;
+                slices[i].capacity++;
+            }
+            slices[i].end = p;
+        }
+    }
+    result.threads = threads;
+
+    for (uint32_t i = 0; i < threads; i++) {
+        slices[i].options = options;
+        slices[i].format = format;
+        slices[i].routes = malloc((slices[i].capacity ? slices[i].capacity : 1) * sizeof(routing_route_t));
+        if (!slices[i].routes) {
+            status = STATUS_NO_MEMORY;
+            break;
+        }
+    }
+
+    if (status == STATUS_SUCCESS) {
+        /* The first slice is parsed here once the others are under way */
+        for (uint32_t i = 1; i < threads; i++) {
+            slices[i].started = pthread_create(&slices[i].thread, NULL, loader_parse_slice, &slices[i]) == 0;
+        }
+        loader_parse_slice(&slices[0]);
+
+        status = routing_table_begin_batch();
+        own_batch = status == STATUS_SUCCESS;
+        if (status == STATUS_RESOURCE_BUSY) {
+            status = STATUS_SUCCESS;
+        }
+
+        for (uint32_t i = 0; i < threads; i++) {
+            if (slices[i].started) {
+                pthread_join(slices[i].thread, NULL);
+            } else if (i > 0) {
+                loader_parse_slice(&slices[i]);
+            }
+            if (i == threads - 1) {
+                result.parse_us = loader_now_us() - start_us;
+            }
+
+            result.routes_parsed += slices[i].count;
+            result.skipped += slices[i].skipped;
+            result.malformed += slices[i].malformed;
+
+            if (status == STATUS_SUCCESS) {
+                uint32_t added = 0;
+                status = routing_table_add_routes(slices[i].routes, slices[i].count, &added);
+                result.routes_added += added;
+            }
+            free(slices[i].routes);
+            slices[i].routes = NULL;
+        }
+
+        if (own_batch) {
+            status_t commit_status = routing_table_commit_batch();
+            if (status == STATUS_SUCCESS) {
+                status = commit_status;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < threads; i++) {
+        free(slices[i].routes);
+    }
+    munmap((void *)base, size);
+
+    result.total_us = loader_now_us() - start_us;
+    if (stats) {
+        *stats = result;
+    }
+
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Loading routes from %s failed: %d", path, status);
+        return status;
+    }
+
+    LOG_INFO(LOG_CATEGORY_L3, "Loaded %u routes (%u new) from %s in %llu ms, %u threads, %u malformed",
+             result.routes_parsed, result.routes_added, path,
+             (unsigned long long)(result.total_us / 1000), threads, result.malformed);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Write every route of the default VRF to a route image
+ *
+ * @param path File to write, replaced if it exists
+ * @param[out] routes Routes written, may be NULL
+ * @return STATUS_SUCCESS on success, error code otherwise
+ */
+status_t route_loader_dump(const char *path, uint32_t *routes) {
+    uint8_t header[ROUTE_LOADER_IMAGE_HEADER_LEN];
+    loader_dump_t dump;
+    status_t status;
+
+    if (!path) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(&dump, 0, sizeof(dump));
+    dump.file = fopen(path, "wb");
+    if (!dump.file) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Cannot create route image %s", path);
+        return STATUS_FAILURE;
+    }
+    (void)setvbuf(dump.file, NULL, _IOFBF, 1 << 20);
+
+    /* The count is filled in once the walk is done */
+    memset(header, 0, sizeof(header));
+    memcpy(header, ROUTE_LOADER_IMAGE_MAGIC, 4);
+    loader_put16(header + 4, ROUTE_LOADER_IMAGE_VERSION);
+    loader_put16(header + 6, ROUTE_LOADER_IMAGE_RECORD_LEN);
+    dump.error = fwrite(header, sizeof(header), 1, dump.file) != 1;
+
+    status = routing_table_walk(loader_dump_route, &dump);
+
+    loader_put32(header + 8, dump.count);
+    if (!dump.error && (fseek(dump.file, 8, SEEK_SET) != 0 || fwrite(header + 8, 4, 1, dump.file) != 1)) {
+        dump.error = true;
+    }
+    if (fclose(dump.file) != 0) {
+        dump.error = true;
+    }
+
+    if (status == STATUS_SUCCESS && dump.error) {
+        status = STATUS_FAILURE;
+    }
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Dumping routes to %s failed: %d", path, status);
+        return status;
+    }
+
+    if (routes) {
+        *routes = dump.count;
+    }
+    LOG_INFO(LOG_CATEGORY_L3, "Dumped %u routes to %s", dump.count, path);
+    return STATUS_SUCCESS;
+}
+
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static uint64_t loader_now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+/**
+ * @brief Pick the number of parser threads for a file
+ */
+static uint32_t loader_thread_count(const route_loader_options_t *options, uint64_t records) {
+    uint32_t threads = options->threads;
+
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (uint32_t)cpus : LOADER_DEFAULT_THREADS;
+    }
+    if (threads > ROUTE_LOADER_MAX_THREADS) {
+        threads = ROUTE_LOADER_MAX_THREADS;
+    }
+
+    uint64_t useful = records / LOADER_MIN_SLICE_ROUTES;
+    if (useful < threads) {
+        threads = useful > 0 ? (uint32_t)useful : 1;
+    }
+    return threads;
+}
+
+static void *loader_parse_slice(void *arg) {
+    loader_slice_t *slice = (loader_slice_t *)arg;
+
+    if (slice->format == ROUTE_LOADER_FORMAT_IMAGE) {
+        loader_parse_image(slice);
+    } else {
+        loader_parse_mrt(slice);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Parse the TABLE_DUMP_V2 RIB records of a slice
+ *
+ * Record lengths were checked by the header pass.
+ */
+static void loader_parse_mrt(loader_slice_t *slice) {
+    const uint8_t *p = slice->begin;
+
+    while (p < slice->end) {
+        uint16_t type = loader_get16(p + 4);
+        uint16_t subtype = loader_get16(p + 6);
+        uint32_t length = loader_get32(p + 8);
+        const uint8_t *body = p + MRT_HEADER_LEN;
+        const uint8_t *body_end = body + length;
+        p = body_end;
+
+        if (type != MRT_TYPE_TABLE_DUMP_V2 ||
+            (subtype != MRT_SUBTYPE_RIB_IPV4_UNICAST && subtype != MRT_SUBTYPE_RIB_IPV6_UNICAST)) {
+            /* PEER_INDEX_TABLE, multicast and other records carry no unicast route */
+            slice->skipped++;
+            continue;
+        }
+
+        ip_addr_type_t family = subtype == MRT_SUBTYPE_RIB_IPV4_UNICAST ? IP_TYPE_V4 : IP_TYPE_V6;
+        uint8_t max_len = family == IP_TYPE_V4 ? 32 : 128;
+
+        /* Sequence number, prefix length, prefix */
+        if (length < 5 || body[4] > max_len || length < 5u + (body[4] + 7) / 8 + 2) {
+            slice->malformed++;
+            continue;
+        }
+        uint8_t prefix_len = body[4];
+        uint8_t prefix_bytes = (uint8_t)((prefix_len + 7) / 8);
+
+        routing_route_t *route = &slice->routes[slice->count];
+        memset(route, 0, sizeof(*route));
+        route->type = family;
+        route->prefix.type = family;
+        route->next_hop.type = family;
+        route->prefix_len = prefix_len;
+        route->interface_index = slice->options->interface_index;
+        route->source = slice->options->source;
+        if (family == IP_TYPE_V4) {
+            memcpy(&route->prefix.addr.v4, body + 5, prefix_bytes);
+        } else {
+            memcpy(route->prefix.addr.v6.addr, body + 5, prefix_bytes);
+        }
+
+        const uint8_t *entries = body + 5 + prefix_bytes;
+        if (!loader_parse_rib_entries(entries, body_end, family, slice->options->peer_index, route)) {
+            slice->skipped++;
+            continue;
+        }
+        slice->count++;
+    }
+}
+
+/**
+ * @brief Take the next hop and metric of one RIB entry of a prefix
+ *
+ * @param p Entry count, followed by the entries
+ * @return true if a usable entry was found
+ */
+static bool loader_parse_rib_entries(const uint8_t *p, const uint8_t *end, ip_addr_type_t type,
+                                     uint16_t peer_index, routing_route_t *route) {
+    uint16_t entry_count = loader_get16(p);
+    p += 2;
+
+    for (uint16_t e = 0; e < entry_count; e++) {
+        /* Peer index, originated time, attribute length */
+        if (end - p < 8) {
+            return false;
+        }
+        uint16_t peer = loader_get16(p);
+        uint16_t attr_len = loader_get16(p + 6);
+        const uint8_t *attrs = p + 8;
+        if (end - attrs < attr_len) {
+            return false;
+        }
+        p = attrs + attr_len;
+
+        if (peer_index != ROUTE_LOADER_ANY_PEER && peer != peer_index) {
+            continue;
+        }
+
+        bool have_next_hop = false;
+        for (const uint8_t *a = attrs; a < attrs + attr_len;) {
+            if (attrs + attr_len - a < 3) {
+                return false;
+            }
+            uint8_t flags = a[0];
+            uint8_t code = a[1];
+            uint16_t header = (flags & BGP_ATTR_FLAG_EXTENDED) ? 4 : 3;
+            if (attrs + attr_len - a < header) {
+                return false;
+            }
+            uint16_t len = (flags & BGP_ATTR_FLAG_EXTENDED) ? loader_get16(a + 2) : a[2];
+            const uint8_t *value = a + header;
+            if (attrs + attr_len - value < len) {
+                return false;
+            }
+            a = value + len;
+
+            if (code == BGP_ATTR_NEXT_HOP && type == IP_TYPE_V4 && len == 4) {
+                memcpy(&route->next_hop.addr.v4, value, 4);
+                have_next_hop = true;
+            } else if (code == BGP_ATTR_MED && len == 4) {
+                uint32_t med = loader_get32(value);
+                route->metric = med > UINT16_MAX ? UINT16_MAX : (uint16_t)med;
+            } else if (code == BGP_ATTR_MP_REACH_NLRI && type == IP_TYPE_V6 && len >= 17) {
+                /* RFC 6396 4.3.4 keeps only the next hop length and next hop;
+                   some writers keep AFI and SAFI in front as well */
+                const uint8_t *nh = value;
+                if (nh[0] != 16 && nh[0] != 32 && len >= 20) {
+                    nh = value + 3;
+                }
+                if ((nh[0] == 16 || nh[0] == 32) && (size_t)(nh + 1 + 16 - value) <= len) {
+                    memcpy(route->next_hop.addr.v6.addr, nh + 1, 16);
+                    have_next_hop = true;
+                }
+            }
+        }
+
+        if (have_next_hop) {
+            return true;
+        }
+        route->metric = 0;
+    }
+    return false;
+}
+
+/**
+ * @brief Convert the route image records of a slice
+ */
+static void loader_parse_image(loader_slice_t *slice) {
+    for (const uint8_t *p = slice->begin; p < slice->end; p += ROUTE_LOADER_IMAGE_RECORD_LEN) {
+        ip_addr_type_t family;
+
+        if (p[0] == 4 && p[1] <= 32) {
+            family = IP_TYPE_V4;
+        } else if (p[0] == 6 && p[1] <= 128) {
+            family = IP_TYPE_V6;
+        } else {
+            slice->malformed++;
+            continue;
+        }
+
+        routing_route_t *route = &slice->routes[slice->count++];
+        memset(route, 0, sizeof(*route));
+        route->type = family;
+        route->prefix.type = family;
+        route->next_hop.type = family;
+        route->prefix_len = p[1];
+        route->source = (route_source_t)p[2];
+        route->interface_index = loader_get16(p + 4);
+        route->metric = loader_get16(p + 6);
+        if (family == IP_TYPE_V4) {
+            memcpy(&route->prefix.addr.v4, p + 8, 4);
+            memcpy(&route->next_hop.addr.v4, p + 24, 4);
+        } else {
+            memcpy(route->prefix.addr.v6.addr, p + 8, 16);
+            memcpy(route->next_hop.addr.v6.addr, p + 24, 16);
+        }
+    }
+}
+
+/**
+ * @brief Append one route to a route image
+ */
+static void loader_dump_route(const routing_route_t *route, void *ctx) {
+    loader_dump_t *dump = (loader_dump_t *)ctx;
+    uint8_t record[ROUTE_LOADER_IMAGE_RECORD_LEN];
+
+    if (dump->error) {
+        return;
+    }
+
+    memset(record, 0, sizeof(record));
+    record[0] = route->type == IP_TYPE_V4 ? 4 : 6;
+    record[1] = route->prefix_len;
+    record[2] = (uint8_t)route->source;
+    loader_put16(record + 4, route->interface_index);
+    loader_put16(record + 6, route->metric);
+    if (route->type == IP_TYPE_V4) {
+        memcpy(record + 8, &route->prefix.addr.v4, 4);
+        memcpy(record + 24, &route->next_hop.addr.v4, 4);
+    } else {
+        memcpy(record + 8, route->prefix.addr.v6.addr, 16);
+        memcpy(record + 24, route->next_hop.addr.v6.addr, 16);
+    }
+
+    if (fwrite(record, sizeof(record), 1, dump->file) != 1) {
+        dump->error = true;
+        return;
+    }
+    dump->count++;
+}
+
+static uint16_t loader_get16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t loader_get32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void loader_put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void loader_put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
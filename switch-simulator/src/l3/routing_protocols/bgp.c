@@ -0,0 +1,1629 @@
+/**
+ * @file bgp.c
+ * @brief Implementation of the BGP-4 speaker
+ *
+ * Loc-RIB prefixes and interned attributes live in chained hash tables
+ * that double as they fill. A prefix keeps its paths in a short list, the
+ * best one first in preference, and two bitmaps over the update groups:
+ * the groups it is queued for and the groups it has been advertised to.
+ *
+ * A group flush sorts its queued prefixes by best attribute object, so
+ * the prefixes of one attribute set are contiguous; the exported
+ * attributes of each run are encoded once and its NLRI packed behind
+ * them into UPDATEs of up to 4096 bytes. A new member gets the whole
+ * table the same way, sent to it alone.
+ *
+ * Deliberate simplifications: no route reflection (iBGP-learned paths are
+ * not sent to iBGP groups), unrecognized optional transitive attributes
+ * are dropped rather than passed on, and MED is compared whatever the
+ * neighbor AS.
+ */
+
+#include "l3/bgp.h"
+#include "l3/routing_table.h"
+#include "common/logging.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+/* Defines */
+#define BGP_INITIAL_BUCKETS     1024
+#define BGP_LOCAL_PEER          BGP_MAX_PEERS   /* Peer index of local routes */
+#define BGP_MARKER_LEN          16
+#define BGP_UPDATE_MIN_LEN      (BGP_HEADER_LEN + 4)
+
+/* Path attribute type codes (RFC 4271 5, RFC 1997) */
+#define BGP_ATTR_ORIGIN         1
+#define BGP_ATTR_AS_PATH        2
+#define BGP_ATTR_NEXT_HOP       3
+#define BGP_ATTR_MED            4
+#define BGP_ATTR_LOCAL_PREF     5
+#define BGP_ATTR_COMMUNITIES    8
+
+/* Attribute flags */
+#define BGP_ATTR_FLAG_OPTIONAL      0x80
+#define BGP_ATTR_FLAG_TRANSITIVE    0x40
+#define BGP_ATTR_FLAG_EXTENDED      0x10
+
+/* AS_PATH segment types */
+#define BGP_AS_SET              1
+#define BGP_AS_SEQUENCE         2
+
+/* bgp_attr_t.flags */
+#define BGP_ATTR_HAS_MED        0x01
+#define BGP_ATTR_HAS_LOCAL_PREF 0x02
+
+#define BGP_PREFIX_BYTES(len)   (((len) + 7) / 8)
+#define BGP_PREFIX_MASK(len)    ((len) ? 0xFFFFFFFFu << (32 - (len)) : 0)
+
+/* Private data types */
+
+/* Interned path attributes, shared by every path that carries them */
+typedef struct bgp_attr {
+    struct bgp_attr *hash_next;
+    uint32_t hash;
+    uint32_t refcnt;
+    /* Compared and hashed from here on */
+    uint32_t next_hop;
+    uint32_t med;
+    uint32_t local_pref;
+    uint32_t first_as;              /* Neighbor AS, 0 for an empty path */
+    uint16_t as_path_count;         /* Path length for the decision process */
+    uint16_t as_path_bytes;         /* AS_PATH value at data */
+    uint16_t community_count;       /* Communities follow the AS_PATH, network order */
+    uint8_t origin;
+    uint8_t flags;
+    uint8_t data[];
+} bgp_attr_t;
+
+#define BGP_ATTR_KEY_OFFSET     offsetof(bgp_attr_t, next_hop)
+#define BGP_ATTR_KEY_LEN(a)     (sizeof(bgp_attr_t) - BGP_ATTR_KEY_OFFSET + \
+                                 (a)->as_path_bytes + (a)->community_count * 4u)
+
+/* One path to a prefix */
+typedef struct bgp_path {
+    struct bgp_path *next;
+    bgp_attr_t *attr;
+    uint16_t peer;                  /* Peer index, BGP_LOCAL_PEER for a local route */
+    uint16_t interface_index;
+} bgp_path_t;
+
+/* Loc-RIB prefix */
+typedef struct bgp_dest {
+    struct bgp_dest *hash_next;
+    uint32_t prefix;                /* Host order */
+    uint8_t prefix_len;
+    bool installed;                 /* Best path is in the routing table */
+    uint16_t pending_mask;          /* Groups this prefix is queued for */
+    uint16_t adv_mask;              /* Groups the best path was advertised to */
+    bgp_path_t *paths;
+    bgp_path_t *best;
+} bgp_dest_t;
+
+/* Peer */
+typedef struct {
+    bool used;
+    bool established;
+    bool ibgp;
+    uint8_t group;
+    bgp_peer_config_t config;
+    uint32_t paths;
+} bgp_peer_t;
+
+/* Peers sharing an outbound policy */
+typedef struct {
+    bool used;
+    bool ibgp;
+    bool next_hop_self;
+    uint32_t policy_id;
+    uint32_t local_address;
+    uint32_t members;
+    bgp_dest_t **pending;
+    uint32_t pending_count;
+    uint32_t pending_cap;
+} bgp_group_t;
+
+/* Prefix of a group flush, sorted by what its exported attributes depend on */
+typedef struct {
+    const bgp_attr_t *attr;
+    uint32_t path_class;            /* Local, iBGP or eBGP path */
+    bgp_dest_t *dest;
+} bgp_emit_t;
+
+/* Speaker */
+struct bgp_speaker {
+    bgp_speaker_config_t config;
+    bgp_peer_t peers[BGP_MAX_PEERS];
+    bgp_group_t groups[BGP_MAX_UPDATE_GROUPS];
+    bgp_dest_t **dest_buckets;
+    uint32_t dest_mask;
+    uint32_t dest_count;
+    bgp_attr_t **attr_buckets;
+    uint32_t attr_mask;
+    uint32_t attr_count;
+    uint32_t path_count;
+    bool rib_batch;                 /* We opened the routing table batch */
+    bgp_stats_t stats;
+};
+
+/* Decoded attributes of an UPDATE, before interning */
+typedef struct {
+    bgp_attr_t *attr;               /* Scratch of BGP_MAX_MESSAGE_LEN bytes of data */
+    uint8_t seen;                   /* Well-known mandatory attributes present */
+    bool loop;                      /* AS_PATH contains the local AS */
+} bgp_decoded_t;
+
+enum {
+    BGP_PATH_CLASS_LOCAL = 0,
+    BGP_PATH_CLASS_IBGP,
+    BGP_PATH_CLASS_EBGP
+};
+
+/* Forward declarations of private functions */
+static uint32_t bgp_hash(uint64_t key);
+static bgp_dest_t **bgp_dest_slot(const bgp_speaker_t *sp, uint32_t prefix, uint8_t prefix_len);
+static bgp_dest_t *bgp_dest_get(bgp_speaker_t *sp, uint32_t prefix, uint8_t prefix_len);
+static void bgp_dest_release(bgp_speaker_t *sp, bgp_dest_t *dest);
+static bgp_attr_t *bgp_attr_intern(bgp_speaker_t *sp, const bgp_attr_t *tmpl);
+static void bgp_attr_unintern(bgp_speaker_t *sp, bgp_attr_t *attr);
+static status_t bgp_path_set(bgp_speaker_t *sp, bgp_dest_t *dest, uint16_t peer, bgp_attr_t *attr,
+                             uint16_t interface_index);
+static bool bgp_path_unset(bgp_speaker_t *sp, bgp_dest_t *dest, uint16_t peer);
+static bool bgp_path_better(const bgp_speaker_t *sp, const bgp_path_t *a, const bgp_path_t *b);
+static void bgp_dest_decide(bgp_speaker_t *sp, bgp_dest_t *dest);
+static void bgp_rib_sync(bgp_speaker_t *sp, bgp_dest_t *dest, const bgp_path_t *old_best);
+static void bgp_queue(bgp_speaker_t *sp, bgp_dest_t *dest, uint16_t mask);
+static bool bgp_exportable(const bgp_speaker_t *sp, const bgp_group_t *group, const bgp_path_t *path);
+static uint32_t bgp_path_class(const bgp_speaker_t *sp, const bgp_path_t *path);
+static uint16_t bgp_export_attrs(const bgp_speaker_t *sp, const bgp_group_t *group, const bgp_path_t *path,
+                                 uint8_t *out, uint16_t room);
+static void bgp_group_emit(bgp_speaker_t *sp, uint8_t gi, bgp_emit_t *emit, uint32_t count,
+                           bgp_dest_t **withdrawn, uint32_t withdrawn_count, int target);
+static void bgp_send_message(bgp_speaker_t *sp, uint8_t gi, uint8_t *msg, uint16_t len, int target);
+static bool bgp_group_active(const bgp_speaker_t *sp, uint8_t gi);
+static void bgp_group_flush(bgp_speaker_t *sp, uint8_t gi);
+static void bgp_group_forget(bgp_speaker_t *sp, uint8_t gi);
+static void bgp_peer_dump(bgp_speaker_t *sp, uint16_t peer);
+static void bgp_peer_clear(bgp_speaker_t *sp, uint16_t peer);
+static status_t bgp_decode_attrs(const bgp_speaker_t *sp, const bgp_peer_t *peer, const uint8_t *p,
+                                 uint16_t len, bgp_decoded_t *out);
+static int bgp_decode_prefix(const uint8_t *p, uint16_t room, uint32_t *prefix, uint8_t *prefix_len);
+static uint16_t bgp_encode_prefix(uint8_t *p, uint32_t prefix, uint8_t prefix_len);
+static int bgp_emit_compare(const void *a, const void *b);
+static void bgp_put16(uint8_t *p, uint16_t v);
+static void bgp_put32(uint8_t *p, uint32_t v);
+static uint16_t bgp_get16(const uint8_t *p);
+static uint32_t bgp_get32(const uint8_t *p);
+
+/**
+ * @brief Create a speaker
+ *
+ * @param config Parameters, copied
+ * @return New speaker, or NULL if out of memory or config is invalid
+ */
+bgp_speaker_t *bgp_speaker_create(const bgp_speaker_config_t *config) {
+    if (!config || !config->send || config->local_as == 0) {
+        return NULL;
+    }
+
+    bgp_speaker_t *sp = calloc(1, sizeof(*sp));
+    if (!sp) {
+        return NULL;
+    }
+
+    sp->dest_buckets = calloc(BGP_INITIAL_BUCKETS, sizeof(*sp->dest_buckets));
+    sp->attr_buckets = calloc(BGP_INITIAL_BUCKETS, sizeof(*sp->attr_buckets));
+    if (!sp->dest_buckets || !sp->attr_buckets) {
+        free(sp->dest_buckets);
+        free(sp->attr_buckets);
+        free(sp);
+        return NULL;
+    }
+    sp->dest_mask = BGP_INITIAL_BUCKETS - 1;
+    sp->attr_mask = BGP_INITIAL_BUCKETS - 1;
+    sp->config = *config;
+    return sp;
+}
+
+/**
+ * @brief Free a speaker; its routes are removed from the routing table
+ *
+ * @param speaker Speaker, may be NULL
+ */
+void bgp_speaker_destroy(bgp_speaker_t *speaker) {
+    bgp_speaker_t *sp = speaker;
+
+    if (!sp) {
+        return;
+    }
+
+    for (uint32_t i = 0; i <= sp->dest_mask; i++) {
+        bgp_dest_t *dest = sp->dest_buckets[i];
+        while (dest) {
+            bgp_dest_t *next = dest->hash_next;
+            if (dest->installed) {
+                bgp_rib_sync(sp, dest, dest->best);
+            }
+            while (dest->paths) {
+                bgp_path_t *path = dest->paths;
+                dest->paths = path->next;
+                free(path);
+            }
+            free(dest);
+            dest = next;
+        }
+    }
+    if (sp->rib_batch) {
+        (void)routing_table_commit_batch();
+    }
+
+    for (uint32_t i = 0; i <= sp->attr_mask; i++) {
+        bgp_attr_t *attr = sp->attr_buckets[i];
+        while (attr) {
+            bgp_attr_t *next = attr->hash_next;
+            free(attr);
+            attr = next;
+        }
+    }
+    for (int i = 0; i < BGP_MAX_UPDATE_GROUPS; i++) {
+        free(sp->groups[i].pending);
+    }
+
+    free(sp->dest_buckets);
+    free(sp->attr_buckets);
+    free(sp);
+}
+
+/**
+ * @brief Add a peer
+ *
+ * @param speaker Speaker
+ * @param config Peer parameters, copied
+ * @param[out] peer_id Peer identifier
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER,
+ *         STATUS_RESOURCE_EXHAUSTED if out of peers or update groups
+ */
+status_t bgp_peer_add(bgp_speaker_t *speaker, const bgp_peer_config_t *config, uint32_t *peer_id) {
+    bgp_speaker_t *sp = speaker;
+    int slot = -1;
+    int gi = -1;
+
+    if (!sp || !config || !peer_id || config->remote_as == 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    for (int i = 0; i < BGP_MAX_PEERS && slot < 0; i++) {
+        if (!sp->peers[i].used) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        return STATUS_RESOURCE_EXHAUSTED;
+    }
+
+    bool ibgp = config->remote_as == sp->config.local_as;
+    bool nhs = ibgp && config->next_hop_self;
+    for (int i = 0; i < BGP_MAX_UPDATE_GROUPS; i++) {
+        bgp_group_t *group = &sp->groups[i];
+        if (group->used && group->ibgp == ibgp && group->next_hop_self == nhs &&
+            group->policy_id == config->policy_id && group->local_address == config->local_address) {
+            gi = i;
+            break;
+        }
+    }
+    if (gi < 0) {
+        for (int i = 0; i < BGP_MAX_UPDATE_GROUPS; i++) {
+            if (!sp->groups[i].used) {
+                gi = i;
+                break;
+            }
+        }
+        if (gi < 0) {
+            return STATUS_RESOURCE_EXHAUSTED;
+        }
+        bgp_group_t *group = &sp->groups[gi];
+        group->used = true;
+        group->ibgp = ibgp;
+        group->next_hop_self = nhs;
+        group->policy_id = config->policy_id;
+        group->local_address = config->local_address;
+        group->members = 0;
+        group->pending_count = 0;
+        sp->stats.update_groups++;
+    }
+
+    bgp_peer_t *peer = &sp->peers[slot];
+    memset(peer, 0, sizeof(*peer));
+    peer->used = true;
+    peer->ibgp = ibgp;
+    peer->group = (uint8_t)gi;
+    peer->config = *config;
+    sp->groups[gi].members++;
+
+    *peer_id = (uint32_t)slot;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Remove a peer and the paths it sent
+ *
+ * @param speaker Speaker
+ * @param peer_id Peer
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t bgp_peer_remove(bgp_speaker_t *speaker, uint32_t peer_id) {
+    bgp_speaker_t *sp = speaker;
+
+    if (!sp || peer_id >= BGP_MAX_PEERS || !sp->peers[peer_id].used) {
+        return STATUS_NOT_FOUND;
+    }
+
+    bgp_peer_t *peer = &sp->peers[peer_id];
+    bgp_peer_clear(sp, (uint16_t)peer_id);
+    peer->established = false;
+    peer->used = false;
+
+    bgp_group_t *group = &sp->groups[peer->group];
+    if (--group->members == 0) {
+        /* The group goes; what it was sent and queued for goes with it */
+        bgp_group_forget(sp, peer->group);
+        group->used = false;
+        sp->stats.update_groups--;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Report a session transition
+ *
+ * @param speaker Speaker
+ * @param peer_id Peer
+ * @param established New state
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t bgp_peer_set_established(bgp_speaker_t *speaker, uint32_t peer_id, bool established) {
+    bgp_speaker_t *sp = speaker;
+
+    if (!sp || peer_id >= BGP_MAX_PEERS || !sp->peers[peer_id].used) {
+        return STATUS_NOT_FOUND;
+    }
+
+    bgp_peer_t *peer = &sp->peers[peer_id];
+    if (peer->established == established) {
+        return STATUS_SUCCESS;
+    }
+
+    if (established) {
+        /* Earlier changes go out first, so the dump is the latest word */
+        bgp_group_flush(sp, peer->group);
+        peer->established = true;
+        bgp_peer_dump(sp, (uint16_t)peer_id);
+    } else {
+        peer->established = false;
+        bgp_peer_clear(sp, (uint16_t)peer_id);
+        if (!bgp_group_active(sp, peer->group)) {
+            bgp_group_forget(sp, peer->group);
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Process one message received from an Established peer
+ *
+ * @param speaker Speaker
+ * @param peer_id Peer
+ * @param msg Message, header included
+ * @param length Bytes at msg
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND, STATUS_INVALID_PARAMETER
+ *         if the message is malformed, STATUS_NO_MEMORY
+ */
+status_t bgp_peer_input(bgp_speaker_t *speaker, uint32_t peer_id, const uint8_t *msg, uint16_t length) {
+    bgp_speaker_t *sp = speaker;
+    status_t status = STATUS_SUCCESS;
+
+    if (!sp || peer_id >= BGP_MAX_PEERS || !sp->peers[peer_id].used || !sp->peers[peer_id].established) {
+        return STATUS_NOT_FOUND;
+    }
+    if (!msg || length < BGP_HEADER_LEN || length > BGP_MAX_MESSAGE_LEN ||
+        bgp_get16(msg + BGP_MARKER_LEN) != length) {
+        sp->stats.malformed_updates++;
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (msg[18] != BGP_MSG_UPDATE) {
+        return STATUS_SUCCESS;
+    }
+
+    bgp_peer_t *peer = &sp->peers[peer_id];
+    sp->stats.updates_received++;
+
+    if (length < BGP_UPDATE_MIN_LEN) {
+        sp->stats.malformed_updates++;
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    const uint8_t *p = msg + BGP_HEADER_LEN;
+    const uint8_t *end = msg + length;
+    uint16_t withdrawn_len = bgp_get16(p);
+    if (p + 2 + withdrawn_len + 2 > end) {
+        sp->stats.malformed_updates++;
+        return STATUS_INVALID_PARAMETER;
+    }
+    const uint8_t *withdrawn = p + 2;
+    uint16_t attr_len = bgp_get16(withdrawn + withdrawn_len);
+    const uint8_t *attrs = withdrawn + withdrawn_len + 2;
+    if (attrs + attr_len > end) {
+        sp->stats.malformed_updates++;
+        return STATUS_INVALID_PARAMETER;
+    }
+    const uint8_t *nlri = attrs + attr_len;
+    uint16_t nlri_len = (uint16_t)(end - nlri);
+
+    /* Check every prefix before changing anything */
+    for (uint16_t off = 0; off < withdrawn_len;) {
+        uint32_t prefix;
+        uint8_t prefix_len;
+        int used = bgp_decode_prefix(withdrawn + off, withdrawn_len - off, &prefix, &prefix_len);
+        if (used < 0) {
+            sp->stats.malformed_updates++;
+            return STATUS_INVALID_PARAMETER;
+        }
+        off += used;
+    }
+    for (uint16_t off = 0; off < nlri_len;) {
+        uint32_t prefix;
+        uint8_t prefix_len;
+        int used = bgp_decode_prefix(nlri + off, nlri_len - off, &prefix, &prefix_len);
+        if (used < 0) {
+            sp->stats.malformed_updates++;
+            return STATUS_INVALID_PARAMETER;
+        }
+        off += used;
+    }
+
+    bgp_attr_t *attr = NULL;
+    bool loop = false;
+    if (nlri_len > 0) {
+        bgp_decoded_t decoded;
+        decoded.attr = malloc(sizeof(bgp_attr_t) + BGP_MAX_MESSAGE_LEN);
+        if (!decoded.attr) {
+            return STATUS_NO_MEMORY;
+        }
+        status = bgp_decode_attrs(sp, peer, attrs, attr_len, &decoded);
+        if (status == STATUS_SUCCESS) {
+            loop = decoded.loop;
+            /* One attribute object for all the NLRI of the message */
+            attr = loop ? NULL : bgp_attr_intern(sp, decoded.attr);
+            if (!loop && !attr) {
+                status = STATUS_NO_MEMORY;
+            }
+        }
+        free(decoded.attr);
+        if (status != STATUS_SUCCESS) {
+            if (status == STATUS_INVALID_PARAMETER) {
+                sp->stats.malformed_updates++;
+            }
+            return status;
+        }
+    }
+
+    for (uint16_t off = 0; off < withdrawn_len;) {
+        uint32_t prefix;
+        uint8_t prefix_len;
+        off += bgp_decode_prefix(withdrawn + off, withdrawn_len - off, &prefix, &prefix_len);
+
+        bgp_dest_t *dest = *bgp_dest_slot(sp, prefix, prefix_len);
+        if (dest && bgp_path_unset(sp, dest, (uint16_t)peer_id)) {
+            bgp_dest_decide(sp, dest);
+        }
+    }
+
+    for (uint16_t off = 0; off < nlri_len;) {
+        uint32_t prefix;
+        uint8_t prefix_len;
+        off += bgp_decode_prefix(nlri + off, nlri_len - off, &prefix, &prefix_len);
+
+        if (loop) {
+            /* A path through ourselves is treated as withdrawn (RFC 4271 9.1.2) */
+            bgp_dest_t *dest = *bgp_dest_slot(sp, prefix, prefix_len);
+            if (dest && bgp_path_unset(sp, dest, (uint16_t)peer_id)) {
+                bgp_dest_decide(sp, dest);
+            }
+            continue;
+        }
+
+        bgp_dest_t *dest = bgp_dest_get(sp, prefix, prefix_len);
+        if (!dest) {
+            status = STATUS_NO_MEMORY;
+            break;
+        }
+        attr->refcnt++;
+        if (bgp_path_set(sp, dest, (uint16_t)peer_id, attr, peer->config.interface_index) != STATUS_SUCCESS) {
+            attr->refcnt--;
+            bgp_dest_release(sp, dest);
+            status = STATUS_NO_MEMORY;
+            break;
+        }
+        bgp_dest_decide(sp, dest);
+    }
+
+    if (attr) {
+        bgp_attr_unintern(sp, attr);
+    }
+    return status;
+}
+
+/**
+ * @brief Announce a local route, replacing a previous local announcement
+ *
+ * @param speaker Speaker
+ * @param prefix Network address, host order
+ * @param prefix_len 0..32
+ * @param attr Attributes
+ * @param interface_index Interface the route is installed on
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t bgp_announce(bgp_speaker_t *speaker, uint32_t prefix, uint8_t prefix_len,
+                      const bgp_route_attr_t *attr, uint16_t interface_index) {
+    bgp_speaker_t *sp = speaker;
+
+    if (!sp || !attr || prefix_len > 32 || attr->origin > BGP_ORIGIN_INCOMPLETE ||
+        (attr->as_path_len && !attr->as_path) || (attr->community_count && !attr->communities)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Local AS_PATHs are a single AS_SEQUENCE of at most 255 ASes */
+    uint16_t as_path_bytes = attr->as_path_len ? 2 + attr->as_path_len * 4 : 0;
+    if (attr->as_path_len > 255 || as_path_bytes + attr->community_count * 4u > BGP_MAX_MESSAGE_LEN) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    bgp_attr_t *tmpl = calloc(1, sizeof(bgp_attr_t) + as_path_bytes + attr->community_count * 4u);
+    if (!tmpl) {
+        return STATUS_NO_MEMORY;
+    }
+    tmpl->origin = (uint8_t)attr->origin;
+    tmpl->next_hop = attr->next_hop;
+    if (attr->has_med) {
+        tmpl->flags |= BGP_ATTR_HAS_MED;
+        tmpl->med = attr->med;
+    }
+    if (attr->has_local_pref) {
+        tmpl->flags |= BGP_ATTR_HAS_LOCAL_PREF;
+        tmpl->local_pref = attr->local_pref;
+    }
+    if (attr->as_path_len) {
+        tmpl->data[0] = BGP_AS_SEQUENCE;
+        tmpl->data[1] = (uint8_t)attr->as_path_len;
+        for (uint16_t i = 0; i < attr->as_path_len; i++) {
+            bgp_put32(tmpl->data + 2 + i * 4, attr->as_path[i]);
+        }
+        tmpl->first_as = attr->as_path[0];
+    }
+    tmpl->as_path_bytes = as_path_bytes;
+    tmpl->as_path_count = attr->as_path_len;
+    for (uint16_t i = 0; i < attr->community_count; i++) {
+        bgp_put32(tmpl->data + as_path_bytes + i * 4, attr->communities[i]);
+    }
+    tmpl->community_count = attr->community_count;
+
+    bgp_attr_t *interned = bgp_attr_intern(sp, tmpl);
+    free(tmpl);
+    if (!interned) {
+        return STATUS_NO_MEMORY;
+    }
+
+    bgp_dest_t *dest = bgp_dest_get(sp, prefix & BGP_PREFIX_MASK(prefix_len), prefix_len);
+    if (!dest || bgp_path_set(sp, dest, BGP_LOCAL_PEER, interned, interface_index) != STATUS_SUCCESS) {
+        bgp_attr_unintern(sp, interned);
+        if (dest) {
+            bgp_dest_release(sp, dest);
+        }
+        return STATUS_NO_MEMORY;
+    }
+    bgp_dest_decide(sp, dest);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Withdraw a local route
+ *
+ * @param speaker Speaker
+ * @param prefix Network address, host order
+ * @param prefix_len 0..32
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t bgp_withdraw(bgp_speaker_t *speaker, uint32_t prefix, uint8_t prefix_len) {
+    bgp_speaker_t *sp = speaker;
+
+    if (!sp || prefix_len > 32) {
+        return STATUS_NOT_FOUND;
+    }
+
+    bgp_dest_t *dest = *bgp_dest_slot(sp, prefix & BGP_PREFIX_MASK(prefix_len), prefix_len);
+    if (!dest || !bgp_path_unset(sp, dest, BGP_LOCAL_PEER)) {
+        return STATUS_NOT_FOUND;
+    }
+    bgp_dest_decide(sp, dest);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Send the queued changes and commit the routing table batch
+ *
+ * @param speaker Speaker
+ * @return STATUS_SUCCESS on success, error of the routing table commit otherwise
+ */
+status_t bgp_speaker_flush(bgp_speaker_t *speaker) {
+    bgp_speaker_t *sp = speaker;
+    status_t status = STATUS_SUCCESS;
+
+    if (!sp) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (sp->rib_batch) {
+        sp->rib_batch = false;
+        status = routing_table_commit_batch();
+    }
+
+    for (uint8_t gi = 0; gi < BGP_MAX_UPDATE_GROUPS; gi++) {
+        if (sp->groups[gi].used) {
+            bgp_group_flush(sp, gi);
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief Get the best path of a prefix
+ *
+ * @param speaker Speaker
+ * @param prefix Network address, host order
+ * @param prefix_len 0..32
+ * @param[out] next_hop Next hop, host order, may be NULL
+ * @param[out] peer_id Peer that sent the path, BGP_MAX_PEERS for a local route, may be NULL
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND
+ */
+status_t bgp_lookup(const bgp_speaker_t *speaker, uint32_t prefix, uint8_t prefix_len,
+                    uint32_t *next_hop, uint32_t *peer_id) {
+    if (!speaker || prefix_len > 32) {
+        return STATUS_NOT_FOUND;
+    }
+
+    const bgp_dest_t *dest = *bgp_dest_slot(speaker, prefix & BGP_PREFIX_MASK(prefix_len), prefix_len);
+    if (!dest || !dest->best) {
+        return STATUS_NOT_FOUND;
+    }
+
+    if (next_hop) {
+        *next_hop = dest->best->attr->next_hop;
+    }
+    if (peer_id) {
+        *peer_id = dest->best->peer;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get speaker counters
+ *
+ * @param speaker Speaker
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t bgp_get_stats(const bgp_speaker_t *speaker, bgp_stats_t *stats) {
+    if (!speaker || !stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    *stats = speaker->stats;
+    stats->prefixes = speaker->dest_count;
+    stats->paths = speaker->path_count;
+    stats->attrs = speaker->attr_count;
+    return STATUS_SUCCESS;
+}
+
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static uint32_t bgp_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return (uint32_t)key;
+}
+
+/**
+ * @brief Find the chain link that holds, or would hold, a prefix
+ */
+static bgp_dest_t **bgp_dest_slot(const bgp_speaker_t *sp, uint32_t prefix, uint8_t prefix_len) {
+    uint64_t key = ((uint64_t)prefix << 8) | prefix_len;
+    bgp_dest_t **link = &sp->dest_buckets[bgp_hash(key) & sp->dest_mask];
+
+    while (*link && ((*link)->prefix != prefix || (*link)->prefix_len != prefix_len)) {
+        link = &(*link)->hash_next;
+    }
+    return link;
+}
+
+/**
+ * @brief Find a prefix, adding it if it is new
+ *
+ * @return Prefix, NULL if out of memory
+ */
+static bgp_dest_t *bgp_dest_get(bgp_speaker_t *sp, uint32_t prefix, uint8_t prefix_len) {
+    bgp_dest_t **link = bgp_dest_slot(sp, prefix, prefix_len);
+    if (*link) {
+        return *link;
+    }
+
+    if (sp->dest_count > sp->dest_mask) {
+        uint32_t size = (sp->dest_mask + 1) * 2;
+        bgp_dest_t **buckets = calloc(size, sizeof(*buckets));
+        if (buckets) {
+            for (uint32_t i = 0; i <= sp->dest_mask; i++) {
+                bgp_dest_t *dest = sp->dest_buckets[i];
+                while (dest) {
+                    bgp_dest_t *next = dest->hash_next;
+                    uint64_t key = ((uint64_t)dest->prefix << 8) | dest->prefix_len;
+                    uint32_t b = bgp_hash(key) & (size - 1);
+                    dest->hash_next = buckets[b];
+                    buckets[b] = dest;
+                    dest = next;
+                }
+            }
+            free(sp->dest_buckets);
+            sp->dest_buckets = buckets;
+            sp->dest_mask = size - 1;
+            link = bgp_dest_slot(sp, prefix, prefix_len);
+        }
+    }
+
+    bgp_dest_t *dest = calloc(1, sizeof(*dest));
+    if (!dest) {
+        return NULL;
+    }
+    dest->prefix = prefix;
+    dest->prefix_len = prefix_len;
+    *link = dest;
+    sp->dest_count++;
+    return dest;
+}
+
+/**
+ * @brief Free a prefix nothing refers to any more
+ */
+static void bgp_dest_release(bgp_speaker_t *sp, bgp_dest_t *dest) {
+    if (dest->paths || dest->pending_mask || dest->adv_mask || dest->installed) {
+        return;
+    }
+
+    bgp_dest_t **link = bgp_dest_slot(sp, dest->prefix, dest->prefix_len);
+    *link = dest->hash_next;
+    sp->dest_count--;
+    free(dest);
+}
+
+/**
+ * @brief Get the shared copy of a set of attributes, with a reference
+ *
+ * @param tmpl Attributes; the hash fields need not be set
+ * @return Interned attributes, NULL if out of memory
+ */
+static bgp_attr_t *bgp_attr_intern(bgp_speaker_t *sp, const bgp_attr_t *tmpl) {
+    const uint8_t *key = (const uint8_t *)tmpl + BGP_ATTR_KEY_OFFSET;
+    size_t key_len = BGP_ATTR_KEY_LEN(tmpl);
+    uint64_t h = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < key_len; i++) {
+        h = (h ^ key[i]) * 1099511628211ULL;
+    }
+    uint32_t hash = bgp_hash(h);
+
+    for (bgp_attr_t *attr = sp->attr_buckets[hash & sp->attr_mask]; attr; attr = attr->hash_next) {
+        if (attr->hash == hash && BGP_ATTR_KEY_LEN(attr) == key_len &&
+            memcmp((const uint8_t *)attr + BGP_ATTR_KEY_OFFSET, key, key_len) == 0) {
+            attr->refcnt++;
+            return attr;
+        }
+    }
+
+    if (sp->attr_count > sp->attr_mask) {
+        uint32_t size = (sp->attr_mask + 1) * 2;
+        bgp_attr_t **buckets = calloc(size, sizeof(*buckets));
+        if (buckets) {
+            for (uint32_t i = 0; i <= sp->attr_mask; i++) {
+                bgp_attr_t *attr = sp->attr_buckets[i];
+                while (attr) {
+                    bgp_attr_t *next = attr->hash_next;
+                    attr->hash_next = buckets[attr->hash & (size - 1)];
+                    buckets[attr->hash & (size - 1)] = attr;
+                    attr = next;
+                }
+            }
+            free(sp->attr_buckets);
+            sp->attr_buckets = buckets;
+            sp->attr_mask = size - 1;
+        }
+    }
+
+    bgp_attr_t *attr = malloc(BGP_ATTR_KEY_OFFSET + key_len);
+    if (!attr) {
+        return NULL;
+    }
+    memcpy((uint8_t *)attr + BGP_ATTR_KEY_OFFSET, key, key_len);
+    attr->hash = hash;
+    attr->refcnt = 1;
+    attr->hash_next = sp->attr_buckets[hash & sp->attr_mask];
+    sp->attr_buckets[hash & sp->attr_mask] = attr;
+    sp->attr_count++;
+    return attr;
+}
+
+/**
+ * @brief Drop a reference to interned attributes
+ */
+static void bgp_attr_unintern(bgp_speaker_t *sp, bgp_attr_t *attr) {
+    if (--attr->refcnt > 0) {
+        return;
+    }
+
+    bgp_attr_t **link = &sp->attr_buckets[attr->hash & sp->attr_mask];
+    while (*link != attr) {
+        link = &(*link)->hash_next;
+    }
+    *link = attr->hash_next;
+    sp->attr_count--;
+    free(attr);
+}
+
+/**
+ * @brief Set the path a peer offers for a prefix, taking over the attribute reference
+ */
+static status_t bgp_path_set(bgp_speaker_t *sp, bgp_dest_t *dest, uint16_t peer, bgp_attr_t *attr,
+                             uint16_t interface_index) {
+    for (bgp_path_t *path = dest->paths; path; path = path->next) {
+        if (path->peer == peer) {
+            if (dest->best == path && (path->attr != attr || path->interface_index != interface_index)) {
+                /* The best path changed in place; make the decision see it */
+                dest->best = NULL;
+            }
+            bgp_attr_unintern(sp, path->attr);
+            path->attr = attr;
+            path->interface_index = interface_index;
+            return STATUS_SUCCESS;
+        }
+    }
+
+    bgp_path_t *path = malloc(sizeof(*path));
+    if (!path) {
+        return STATUS_NO_MEMORY;
+    }
+    path->attr = attr;
+    path->peer = peer;
+    path->interface_index = interface_index;
+    path->next = dest->paths;
+    dest->paths = path;
+    sp->path_count++;
+    if (peer != BGP_LOCAL_PEER) {
+        sp->peers[peer].paths++;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Remove the path a peer offers for a prefix
+ *
+ * The best path pointer may dangle until bgp_dest_decide().
+ *
+ * @return true if there was one
+ */
+static bool bgp_path_unset(bgp_speaker_t *sp, bgp_dest_t *dest, uint16_t peer) {
+    for (bgp_path_t **link = &dest->paths; *link; link = &(*link)->next) {
+        bgp_path_t *path = *link;
+        if (path->peer == peer) {
+            *link = path->next;
+            if (dest->best == path) {
+                /* Keep what was installed reachable for the RIB update */
+                dest->best = NULL;
+                bgp_rib_sync(sp, dest, path);
+            }
+            bgp_attr_unintern(sp, path->attr);
+            free(path);
+            sp->path_count--;
+            if (peer != BGP_LOCAL_PEER) {
+                sp->peers[peer].paths--;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief BGP decision process (RFC 4271 9.1.2.2), local routes first
+ *
+ * @return true if a is preferred over b
+ */
+static bool bgp_path_better(const bgp_speaker_t *sp, const bgp_path_t *a, const bgp_path_t *b) {
+    const bgp_attr_t *x = a->attr;
+    const bgp_attr_t *y = b->attr;
+
+    if ((a->peer == BGP_LOCAL_PEER) != (b->peer == BGP_LOCAL_PEER)) {
+        return a->peer == BGP_LOCAL_PEER;
+    }
+
+    uint32_t lp_x = (x->flags & BGP_ATTR_HAS_LOCAL_PREF) ? x->local_pref : BGP_DEFAULT_LOCAL_PREF;
+    uint32_t lp_y = (y->flags & BGP_ATTR_HAS_LOCAL_PREF) ? y->local_pref : BGP_DEFAULT_LOCAL_PREF;
+    if (lp_x != lp_y) {
+        return lp_x > lp_y;
+    }
+    if (x->as_path_count != y->as_path_count) {
+        return x->as_path_count < y->as_path_count;
+    }
+    if (x->origin != y->origin) {
+        return x->origin < y->origin;
+    }
+
+    uint32_t med_x = (x->flags & BGP_ATTR_HAS_MED) ? x->med : 0;
+    uint32_t med_y = (y->flags & BGP_ATTR_HAS_MED) ? y->med : 0;
+    if (med_x != med_y) {
+        return med_x < med_y;
+    }
+    if (a->peer == BGP_LOCAL_PEER) {
+        return false;
+    }
+
+    const bgp_peer_t *pa = &sp->peers[a->peer];
+    const bgp_peer_t *pb = &sp->peers[b->peer];
+    if (pa->ibgp != pb->ibgp) {
+        return !pa->ibgp;
+    }
+    if (pa->config.router_id != pb->config.router_id) {
+        return pa->config.router_id < pb->config.router_id;
+    }
+    return pa->config.address < pb->config.address;
+}
+
+/**
+ * @brief Pick the best path of a prefix and propagate a change
+ */
+static void bgp_dest_decide(bgp_speaker_t *sp, bgp_dest_t *dest) {
+    bgp_path_t *old_best = dest->best;
+    bgp_path_t *best = NULL;
+
+    for (bgp_path_t *path = dest->paths; path; path = path->next) {
+        if (!best || bgp_path_better(sp, path, best)) {
+            best = path;
+        }
+    }
+    dest->best = best;
+
+    if (best != old_best || !best) {
+        bgp_rib_sync(sp, dest, NULL);
+
+        uint16_t mask = 0;
+        for (int i = 0; i < BGP_MAX_UPDATE_GROUPS; i++) {
+            if (sp->groups[i].used && (dest->adv_mask & (1u << i) ||
+                                       (best && bgp_exportable(sp, &sp->groups[i], best)))) {
+                mask |= (uint16_t)(1u << i);
+            }
+        }
+        bgp_queue(sp, dest, mask);
+    }
+
+    bgp_dest_release(sp, dest);
+}
+
+/**
+ * @brief Bring the routing table in line with the best path of a prefix
+ *
+ * @param removed Path being removed that may be installed, or NULL
+ */
+static void bgp_rib_sync(bgp_speaker_t *sp, bgp_dest_t *dest, const bgp_path_t *removed) {
+    ip_addr_t prefix;
+    ip_addr_t next_hop;
+
+    if (!sp->config.install_routes) {
+        return;
+    }
+
+    if (!sp->rib_batch && routing_table_begin_batch() == STATUS_SUCCESS) {
+        sp->rib_batch = true;
+    }
+
+    memset(&prefix, 0, sizeof(prefix));
+    prefix.type = IP_TYPE_V4;
+    prefix.addr.v4 = htonl(dest->prefix);
+
+    if (dest->installed && (removed || dest->best)) {
+        (void)routing_remove_route_source(&prefix, dest->prefix_len, IP_TYPE_V4, ROUTE_TYPE_BGP);
+        dest->installed = false;
+        sp->stats.rib_changes++;
+    }
+
+    if (dest->best && !removed) {
+        const bgp_path_t *best = dest->best;
+        uint32_t nh = best->attr->next_hop;
+
+        memset(&next_hop, 0, sizeof(next_hop));
+        next_hop.type = IP_TYPE_V4;
+        next_hop.addr.v4 = htonl(nh);
+        uint16_t metric = (best->attr->flags & BGP_ATTR_HAS_MED) && best->attr->med < 0xFFFF ?
+                          (uint16_t)best->attr->med : 0;
+        if (routing_add_route(&prefix, dest->prefix_len, IP_TYPE_V4, &next_hop,
+                              best->interface_index, metric, ROUTE_TYPE_BGP) == STATUS_SUCCESS) {
+            dest->installed = true;
+            sp->stats.rib_changes++;
+        }
+    }
+}
+
+/**
+ * @brief Queue a prefix for the groups of a mask
+ */
+static void bgp_queue(bgp_speaker_t *sp, bgp_dest_t *dest, uint16_t mask) {
+    for (int i = 0; i < BGP_MAX_UPDATE_GROUPS; i++) {
+        uint16_t bit = (uint16_t)(1u << i);
+        if (!(mask & bit) || (dest->pending_mask & bit)) {
+            continue;
+        }
+
+        bgp_group_t *group = &sp->groups[i];
+        if (group->pending_count == group->pending_cap) {
+            uint32_t cap = group->pending_cap ? group->pending_cap * 2 : 256;
+            bgp_dest_t **pending = realloc(group->pending, cap * sizeof(*pending));
+            if (!pending) {
+                LOG_ERROR(LOG_CATEGORY_L3, "BGP update group %d queue full, change not advertised", i);
+                continue;
+            }
+            group->pending = pending;
+            group->pending_cap = cap;
+        }
+        group->pending[group->pending_count++] = dest;
+        dest->pending_mask |= bit;
+    }
+}
+
+/**
+ * @brief Check whether a group is sent a path
+ */
+static bool bgp_exportable(const bgp_speaker_t *sp, const bgp_group_t *group, const bgp_path_t *path) {
+    /* No route reflection: iBGP paths stay out of iBGP */
+    return !(group->ibgp && path->peer != BGP_LOCAL_PEER && sp->peers[path->peer].ibgp);
+}
+
+static uint32_t bgp_path_class(const bgp_speaker_t *sp, const bgp_path_t *path) {
+    if (path->peer == BGP_LOCAL_PEER) {
+        return BGP_PATH_CLASS_LOCAL;
+    }
+    return sp->peers[path->peer].ibgp ? BGP_PATH_CLASS_IBGP : BGP_PATH_CLASS_EBGP;
+}
+
+/**
+ * @brief Encode the path attributes a group is sent for a path
+ *
+ * @return Bytes written, 0 if they do not fit
+ */
+static uint16_t bgp_export_attrs(const bgp_speaker_t *sp, const bgp_group_t *group, const bgp_path_t *path,
+                                 uint8_t *out, uint16_t room) {
+    const bgp_attr_t *attr = path->attr;
+    bool local = path->peer == BGP_LOCAL_PEER;
+    uint32_t as_path_len = attr->as_path_bytes;
+    bool prepend_new = false;
+    uint16_t pos = 0;
+
+    /* eBGP prepends the local AS, in the leading AS_SEQUENCE if there is room */
+    if (!group->ibgp) {
+        prepend_new = !(attr->as_path_bytes && attr->data[0] == BGP_AS_SEQUENCE && attr->data[1] < 255);
+        as_path_len += prepend_new ? 6 : 4;
+    }
+    uint32_t need = 4 + 4 + (as_path_len > 255 ? 4 : 3) + as_path_len + 7 + 7 + 7 +
+                    (attr->community_count ? (attr->community_count * 4u > 255 ? 4 : 3) + attr->community_count * 4u : 0);
+    if (need > room) {
+        return 0;
+    }
+
+    out[pos++] = BGP_ATTR_FLAG_TRANSITIVE;
+    out[pos++] = BGP_ATTR_ORIGIN;
+    out[pos++] = 1;
+    out[pos++] = attr->origin;
+
+    if (as_path_len > 255) {
+        out[pos++] = BGP_ATTR_FLAG_TRANSITIVE | BGP_ATTR_FLAG_EXTENDED;
+        out[pos++] = BGP_ATTR_AS_PATH;
+        bgp_put16(out + pos, (uint16_t)as_path_len);
+        pos += 2;
+    } else {
+        out[pos++] = BGP_ATTR_FLAG_TRANSITIVE;
+        out[pos++] = BGP_ATTR_AS_PATH;
+        out[pos++] = (uint8_t)as_path_len;
+    }
+    if (group->ibgp) {
+        memcpy(out + pos, attr->data, attr->as_path_bytes);
+        pos += attr->as_path_bytes;
+    } else if (prepend_new) {
+        out[pos++] = BGP_AS_SEQUENCE;
+        out[pos++] = 1;
+        bgp_put32(out + pos, sp->config.local_as);
+        pos += 4;
+        memcpy(out + pos, attr->data, attr->as_path_bytes);
+        pos += attr->as_path_bytes;
+    } else {
+        out[pos++] = BGP_AS_SEQUENCE;
+        out[pos++] = (uint8_t)(attr->data[1] + 1);
+        bgp_put32(out + pos, sp->config.local_as);
+        pos += 4;
+        memcpy(out + pos, attr->data + 2, attr->as_path_bytes - 2);
+        pos += attr->as_path_bytes - 2;
+    }
+
+    uint32_t next_hop = attr->next_hop;
+    if (!group->ibgp || group->next_hop_self || next_hop == 0) {
+        next_hop = group->local_address;
+    }
+    out[pos++] = BGP_ATTR_FLAG_TRANSITIVE;
+    out[pos++] = BGP_ATTR_NEXT_HOP;
+    out[pos++] = 4;
+    bgp_put32(out + pos, next_hop);
+    pos += 4;
+
+    /* A neighbor AS's MED does not travel on to other ASes */
+    if ((attr->flags & BGP_ATTR_HAS_MED) && (group->ibgp || local)) {
+        out[pos++] = BGP_ATTR_FLAG_OPTIONAL;
+        out[pos++] = BGP_ATTR_MED;
+        out[pos++] = 4;
+        bgp_put32(out + pos, attr->med);
+        pos += 4;
+    }
+
+    if (group->ibgp) {
+        out[pos++] = BGP_ATTR_FLAG_TRANSITIVE;
+        out[pos++] = BGP_ATTR_LOCAL_PREF;
+        out[pos++] = 4;
+        bgp_put32(out + pos, (attr->flags & BGP_ATTR_HAS_LOCAL_PREF) ? attr->local_pref : BGP_DEFAULT_LOCAL_PREF);
+        pos += 4;
+    }
+
+    if (attr->community_count) {
+        uint16_t bytes = (uint16_t)(attr->community_count * 4u);
+        if (bytes > 255) {
+            out[pos++] = BGP_ATTR_FLAG_OPTIONAL | BGP_ATTR_FLAG_TRANSITIVE | BGP_ATTR_FLAG_EXTENDED;
+            out[pos++] = BGP_ATTR_COMMUNITIES;
+            bgp_put16(out + pos, bytes);
+            pos += 2;
+        } else {
+            out[pos++] = BGP_ATTR_FLAG_OPTIONAL | BGP_ATTR_FLAG_TRANSITIVE;
+            out[pos++] = BGP_ATTR_COMMUNITIES;
+            out[pos++] = (uint8_t)bytes;
+        }
+        memcpy(out + pos, attr->data + attr->as_path_bytes, bytes);
+        pos += bytes;
+    }
+
+    return pos;
+}
+
+/**
+ * @brief Format withdrawals and announcements and send them
+ *
+ * @param emit Prefixes to announce, sorted by bgp_emit_compare()
+ * @param withdrawn Prefixes to withdraw
+ * @param target Peer index to send to, -1 for every Established member
+ */
+static void bgp_group_emit(bgp_speaker_t *sp, uint8_t gi, bgp_emit_t *emit, uint32_t count,
+                           bgp_dest_t **withdrawn, uint32_t withdrawn_count, int target) {
+    bgp_group_t *group = &sp->groups[gi];
+    uint8_t msg[BGP_MAX_MESSAGE_LEN];
+    uint16_t len;
+
+    /* Withdrawals: header, withdrawn length, prefixes, zero attribute length */
+    uint32_t i = 0;
+    while (i < withdrawn_count) {
+        len = BGP_HEADER_LEN + 2;
+        uint32_t n = 0;
+        while (i < withdrawn_count &&
+               len + 1 + BGP_PREFIX_BYTES(withdrawn[i]->prefix_len) + 2 <= BGP_MAX_MESSAGE_LEN) {
+            len += bgp_encode_prefix(msg + len, withdrawn[i]->prefix, withdrawn[i]->prefix_len);
+            i++;
+            n++;
+        }
+        bgp_put16(msg + BGP_HEADER_LEN, (uint16_t)(len - BGP_HEADER_LEN - 2));
+        bgp_put16(msg + len, 0);
+        len += 2;
+        bgp_send_message(sp, gi, msg, len, target);
+        sp->stats.withdrawn_sent += n;
+    }
+
+    /* Announcements: one attribute encoding per run, NLRI packed behind it */
+    i = 0;
+    while (i < count) {
+        uint32_t run_end = i + 1;
+        while (run_end < count && emit[run_end].attr == emit[i].attr &&
+               emit[run_end].path_class == emit[i].path_class) {
+            run_end++;
+        }
+
+        uint8_t *attrs = msg + BGP_HEADER_LEN + 4;
+        uint16_t attr_len = bgp_export_attrs(sp, group, emit[i].dest->best, attrs,
+                                             BGP_MAX_MESSAGE_LEN - BGP_HEADER_LEN - 4 - 5);
+        if (attr_len == 0) {
+            LOG_WARNING(LOG_CATEGORY_L3, "BGP attributes too long, %u prefixes not advertised", run_end - i);
+            i = run_end;
+            continue;
+        }
+
+        while (i < run_end) {
+            len = BGP_HEADER_LEN + 4 + attr_len;
+            uint32_t n = 0;
+            while (i < run_end && len + 1 + BGP_PREFIX_BYTES(emit[i].dest->prefix_len) <= BGP_MAX_MESSAGE_LEN) {
+                len += bgp_encode_prefix(msg + len, emit[i].dest->prefix, emit[i].dest->prefix_len);
+                i++;
+                n++;
+            }
+            bgp_put16(msg + BGP_HEADER_LEN, 0);
+            bgp_put16(msg + BGP_HEADER_LEN + 2, attr_len);
+            bgp_send_message(sp, gi, msg, len, target);
+            sp->stats.nlri_sent += n;
+        }
+    }
+}
+
+/**
+ * @brief Finish a message header and hand the message to the members
+ */
+static void bgp_send_message(bgp_speaker_t *sp, uint8_t gi, uint8_t *msg, uint16_t len, int target) {
+    memset(msg, 0xFF, BGP_MARKER_LEN);
+    bgp_put16(msg + BGP_MARKER_LEN, len);
+    msg[18] = BGP_MSG_UPDATE;
+    sp->stats.updates_formatted++;
+
+    for (int i = 0; i < BGP_MAX_PEERS; i++) {
+        const bgp_peer_t *peer = &sp->peers[i];
+        if (!peer->used || !peer->established || peer->group != gi || (target >= 0 && i != target)) {
+            continue;
+        }
+        if (sp->config.send((uint32_t)i, msg, len, sp->config.ctx) == STATUS_SUCCESS) {
+            sp->stats.messages_sent++;
+        }
+    }
+}
+
+/**
+ * @brief Check whether a group has an Established member
+ */
+static bool bgp_group_active(const bgp_speaker_t *sp, uint8_t gi) {
+    for (int i = 0; i < BGP_MAX_PEERS; i++) {
+        if (sp->peers[i].used && sp->peers[i].established && sp->peers[i].group == gi) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Send a group the changes queued for it
+ */
+static void bgp_group_flush(bgp_speaker_t *sp, uint8_t gi) {
+    bgp_group_t *group = &sp->groups[gi];
+    uint16_t bit = (uint16_t)(1u << gi);
+    bool active = bgp_group_active(sp, gi);
+
+    if (group->pending_count == 0) {
+        return;
+    }
+
+    bgp_emit_t *emit = active ? malloc(group->pending_count * sizeof(*emit)) : NULL;
+    bgp_dest_t **withdrawn = active ? malloc(group->pending_count * sizeof(*withdrawn)) : NULL;
+    uint32_t emit_count = 0;
+    uint32_t withdrawn_count = 0;
+    if (active && (!emit || !withdrawn)) {
+        /* Keep the queue for the next flush */
+        free(emit);
+        free(withdrawn);
+        return;
+    }
+
+    for (uint32_t i = 0; i < group->pending_count; i++) {
+        bgp_dest_t *dest = group->pending[i];
+        dest->pending_mask &= (uint16_t)~bit;
+
+        if (!active) {
+            /* Nobody to tell; the next member gets the whole table */
+            dest->adv_mask &= (uint16_t)~bit;
+        } else if (dest->best && bgp_exportable(sp, group, dest->best)) {
+            emit[emit_count].attr = dest->best->attr;
+            emit[emit_count].path_class = bgp_path_class(sp, dest->best);
+            emit[emit_count].dest = dest;
+            emit_count++;
+            dest->adv_mask |= bit;
+        } else if (dest->adv_mask & bit) {
+            withdrawn[withdrawn_count++] = dest;
+            dest->adv_mask &= (uint16_t)~bit;
+        }
+    }
+
+    if (active) {
+        qsort(emit, emit_count, sizeof(*emit), bgp_emit_compare);
+        bgp_group_emit(sp, gi, emit, emit_count, withdrawn, withdrawn_count, -1);
+    }
+
+    /* Prefixes left with no path are freed once no group refers to them */
+    for (uint32_t i = 0; i < group->pending_count; i++) {
+        bgp_dest_release(sp, group->pending[i]);
+    }
+    group->pending_count = 0;
+    free(emit);
+    free(withdrawn);
+}
+
+/**
+ * @brief Drop what a group with no Established member was queued and sent
+ *
+ * Its next member starts from the full table dump.
+ */
+static void bgp_group_forget(bgp_speaker_t *sp, uint8_t gi) {
+    uint16_t bit = (uint16_t)(1u << gi);
+
+    bgp_group_flush(sp, gi);
+    for (uint32_t b = 0; b <= sp->dest_mask; b++) {
+        bgp_dest_t *dest = sp->dest_buckets[b];
+        while (dest) {
+            bgp_dest_t *next = dest->hash_next;
+            if (dest->adv_mask & bit) {
+                dest->adv_mask &= (uint16_t)~bit;
+                bgp_dest_release(sp, dest);
+            }
+            dest = next;
+        }
+    }
+}
+
+/**
+ * @brief Send a peer that just came up the whole table
+ */
+static void bgp_peer_dump(bgp_speaker_t *sp, uint16_t peer) {
+    uint8_t gi = sp->peers[peer].group;
+    bgp_group_t *group = &sp->groups[gi];
+    uint16_t bit = (uint16_t)(1u << gi);
+    uint32_t count = 0;
+
+    bgp_emit_t *emit = malloc((sp->dest_count ? sp->dest_count : 1) * sizeof(*emit));
+    if (!emit) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Out of memory for the initial BGP update of peer %u", peer);
+        return;
+    }
+
+    for (uint32_t b = 0; b <= sp->dest_mask; b++) {
+        for (bgp_dest_t *dest = sp->dest_buckets[b]; dest; dest = dest->hash_next) {
+            if (dest->best && bgp_exportable(sp, group, dest->best)) {
+                emit[count].attr = dest->best->attr;
+                emit[count].path_class = bgp_path_class(sp, dest->best);
+                emit[count].dest = dest;
+                count++;
+                dest->adv_mask |= bit;
+            }
+        }
+    }
+
+    qsort(emit, count, sizeof(*emit), bgp_emit_compare);
+    bgp_group_emit(sp, gi, emit, count, NULL, 0, peer);
+    free(emit);
+}
+
+/**
+ * @brief Remove every path a peer sent
+ */
+static void bgp_peer_clear(bgp_speaker_t *sp, uint16_t peer) {
+    if (sp->peers[peer].paths == 0) {
+        return;
+    }
+
+    for (uint32_t b = 0; b <= sp->dest_mask; b++) {
+        bgp_dest_t *dest = sp->dest_buckets[b];
+        while (dest) {
+            /* Deciding may free the prefix */
+            bgp_dest_t *next = dest->hash_next;
+            if (bgp_path_unset(sp, dest, peer)) {
+                bgp_dest_decide(sp, dest);
+            }
+            dest = next;
+        }
+    }
+}
+
+/**
+ * @brief Decode the path attributes of an UPDATE that carries NLRI
+ *
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER if malformed or a
+ *         well-known mandatory attribute is missing
+ */
+static status_t bgp_decode_attrs(const bgp_speaker_t *sp, const bgp_peer_t *peer, const uint8_t *p,
+                                 uint16_t len, bgp_decoded_t *out) {
+    bgp_attr_t *attr = out->attr;
+    const uint8_t *as_path = NULL;
+    uint16_t as_path_bytes = 0;
+    const uint8_t *communities = NULL;
+    uint16_t community_bytes = 0;
+
+    memset(attr, 0, sizeof(*attr));
+    out->seen = 0;
+    out->loop = false;
+
+    for (uint16_t off = 0; off < len;) {
+        if (len - off < 3) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        uint8_t flags = p[off];
+        uint8_t type = p[off + 1];
+        uint16_t value_len;
+        uint16_t header = (flags & BGP_ATTR_FLAG_EXTENDED) ? 4 : 3;
+        if (len - off < header) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        value_len = (flags & BGP_ATTR_FLAG_EXTENDED) ? bgp_get16(p + off + 2) : p[off + 2];
+        if (len - off - header < value_len) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        const uint8_t *value = p + off + header;
+        off += header + value_len;
+
+        switch (type) {
+            case BGP_ATTR_ORIGIN:
+                if (value_len != 1 || value[0] > BGP_ORIGIN_INCOMPLETE) {
+                    return STATUS_INVALID_PARAMETER;
+                }
+                attr->origin = value[0];
+                out->seen |= 1u << BGP_ATTR_ORIGIN;
+                break;
+
+            case BGP_ATTR_AS_PATH:
+                for (uint16_t s = 0; s < value_len;) {
+                    if (value_len - s < 2 || (value[s] != BGP_AS_SET && value[s] != BGP_AS_SEQUENCE) ||
+                        value[s + 1] == 0 || value_len - s - 2 < value[s + 1] * 4) {
+                        return STATUS_INVALID_PARAMETER;
+                    }
+                    for (uint8_t a = 0; a < value[s + 1]; a++) {
+                        uint32_t asn = bgp_get32(value + s + 2 + a * 4);
+                        if (asn == sp->config.local_as) {
+                            out->loop = true;
+                        }
+                        if (s == 0 && a == 0 && value[s] == BGP_AS_SEQUENCE) {
+                            attr->first_as = asn;
+                        }
+                    }
+                    attr->as_path_count += value[s] == BGP_AS_SET ? 1 : value[s + 1];
+                    s += 2 + value[s + 1] * 4;
+                }
+                as_path = value;
+                as_path_bytes = value_len;
+                out->seen |= 1u << BGP_ATTR_AS_PATH;
+                break;
+
+            case BGP_ATTR_NEXT_HOP:
+                if (value_len != 4) {
+                    return STATUS_INVALID_PARAMETER;
+                }
+                attr->next_hop = bgp_get32(value);
+                out->seen |= 1u << BGP_ATTR_NEXT_HOP;
+                break;
+
+            case BGP_ATTR_MED:
+                if (value_len != 4) {
+                    return STATUS_INVALID_PARAMETER;
+                }
+                attr->med = bgp_get32(value);
+                attr->flags |= BGP_ATTR_HAS_MED;
+                break;
+
+            case BGP_ATTR_LOCAL_PREF:
+                if (value_len != 4) {
+                    return STATUS_INVALID_PARAMETER;
+                }
+                /* Only meaningful inside the AS (RFC 4271 5.1.5) */
+                if (peer->ibgp) {
+                    attr->local_pref = bgp_get32(value);
+                    attr->flags |= BGP_ATTR_HAS_LOCAL_PREF;
+                }
+                break;
+
+            case BGP_ATTR_COMMUNITIES:
+                if (value_len % 4) {
+                    return STATUS_INVALID_PARAMETER;
+                }
+                communities = value;
+                community_bytes = value_len;
+                break;
+
+            default:
+                /* Unknown well-known attributes are an error, optional ones are dropped */
+                if (!(flags & BGP_ATTR_FLAG_OPTIONAL)) {
+                    return STATUS_INVALID_PARAMETER;
+                }
+                break;
+        }
+    }
+
+    uint8_t mandatory = (1u << BGP_ATTR_ORIGIN) | (1u << BGP_ATTR_AS_PATH) | (1u << BGP_ATTR_NEXT_HOP);
+    if ((out->seen & mandatory) != mandatory) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* An eBGP peer puts its own AS first */
+    if (!peer->ibgp && attr->first_as != peer->config.remote_as) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (as_path_bytes) {
+        memcpy(attr->data, as_path, as_path_bytes);
+    }
+    if (community_bytes) {
+        memcpy(attr->data + as_path_bytes, communities, community_bytes);
+    }
+    attr->as_path_bytes = as_path_bytes;
+    attr->community_count = community_bytes / 4;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Decode one prefix of a withdrawn routes or NLRI field
+ *
+ * @return Bytes used, -1 if malformed
+ */
+static int bgp_decode_prefix(const uint8_t *p, uint16_t room, uint32_t *prefix, uint8_t *prefix_len) {
+    if (room < 1 || p[0] > 32 || room < 1 + BGP_PREFIX_BYTES(p[0])) {
+        return -1;
+    }
+
+    uint32_t addr = 0;
+    for (int i = 0; i < BGP_PREFIX_BYTES(p[0]); i++) {
+        addr |= (uint32_t)p[1 + i] << (24 - 8 * i);
+    }
+    *prefix = addr & BGP_PREFIX_MASK(p[0]);
+    *prefix_len = p[0];
+    return 1 + BGP_PREFIX_BYTES(p[0]);
+}
+
+static uint16_t bgp_encode_prefix(uint8_t *p, uint32_t prefix, uint8_t prefix_len) {
+    p[0] = prefix_len;
+    for (int i = 0; i < BGP_PREFIX_BYTES(prefix_len); i++) {
+        p[1 + i] = (uint8_t)(prefix >> (24 - 8 * i));
+    }
+    return (uint16_t)(1 + BGP_PREFIX_BYTES(prefix_len));
+}
+
+static int bgp_emit_compare(const void *a, const void *b) {
+    const bgp_emit_t *x = (const bgp_emit_t *)a;
+    const bgp_emit_t *y = (const bgp_emit_t *)b;
+
+    if (x->attr != y->attr) {
+        return (uintptr_t)x->attr < (uintptr_t)y->attr ? -1 : 1;
+    }
+    if (x->path_class != y->path_class) {
+        return x->path_class < y->path_class ? -1 : 1;
+    }
+    return 0;
+}
+
+static void bgp_put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void bgp_put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint16_t bgp_get16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t bgp_get32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
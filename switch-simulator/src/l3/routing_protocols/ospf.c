@@ -19,10 +19,12 @@
 
 #include "common/error_codes.h"
 #include "common/logging.h"
+#include "common/sim_clock.h"
 #include "common/types.h"
 #include "hal/packet.h"
 #include "hal/port.h"
 #include "l3/ip.h"
+#include "l3/ospf_throttle.h"
 #include "l3/routing_protocols.h"
 #include "l3/routing_table.h"
 #include "management/stats.h"
@@ -274,11 +276,8 @@ typedef struct {
     uint8_t  router_type;  /* ABR, ASBR flags */
     bool     active;
     uint16_t reference_bandwidth;
-    uint16_t spf_calculation_delay;
-    uint16_t spf_hold_time;
+    ospf_throttle_config_t throttle;  /* SPF back-off and LSA throttling */
     uint16_t lsa_arrival_time;
-    uint16_t lsa_generation_delay;
-    uint16_t lsa_hold_time;
     uint16_t lsa_max_age_time;
     uint16_t lsa_refresh_time;
     uint16_t external_preference;
@@ -355,11 +354,8 @@ error_t ospf_init(void)
     memset(&g_ospf_config, 0, sizeof(g_ospf_config));
     g_ospf_config.active = false;
     g_ospf_config.reference_bandwidth = 100000;  /* 100 Mbps in Kbps */
-    g_ospf_config.spf_calculation_delay = 5;     /* 5 seconds */
-    g_ospf_config.spf_hold_time = 10;            /* 10 seconds */
+    ospf_throttle_get_default_config(&g_ospf_config.throttle);
     g_ospf_config.lsa_arrival_time = 1;          /* 1 second */
-    g_ospf_config.lsa_generation_delay = 5;      /* 5 seconds */
-    g_ospf_config.lsa_hold_time = 7;             /* 7 seconds */
     g_ospf_config.lsa_max_age_time = OSPF_LSA_MAX_AGE;
     g_ospf_config.lsa_refresh_time = OSPF_LSA_REFRESH_TIME;
     g_ospf_config.external_preference = 150;     /* Default external metric */
@@ -425,7 +421,7 @@ error_t ospf_start(void)
     }
     
     g_ospf_config.active = true;
-    g_ospf_config.last_age_check = time(NULL);
+    g_ospf_config.last_age_check = sim_clock_time();
     
     /* Initialize interfaces and start sending Hello packets */
     for (int i = 0; i < g_ospf_config.area_count; i++) {
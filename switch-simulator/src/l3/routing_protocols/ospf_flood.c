@@ -0,0 +1,466 @@
+/**
+ * @file ospf_flood.c
+ * @brief Implementation of packed OSPF update and ack transmission
+ *
+ * Every destination has at most one update and one ack packet under
+ * construction, each in a buffer of the largest OSPF packet the MTU
+ * allows, kept between packets. A newer instance of an LSA that is still
+ * queued replaces the older one instead of travelling in the same packet,
+ * and an ack already queued is not queued twice. An LSA too large for any
+ * packet is sent alone and left to IP fragmentation.
+ */
+
+#include "l3/ospf_flood.h"
+#include "l3/ospf_lsdb.h"
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+/* Defines */
+#define FLOOD_OSPF_VERSION      2
+#define FLOOD_TYPE_LS_UPDATE    4
+#define FLOOD_TYPE_LS_ACK       5
+#define FLOOD_LSU_COUNT_LEN     4               /* # LSAs field of an update */
+#define FLOOD_DO_NOT_AGE        0x8000          /* DoNotAge bit of LS age (RFC 1793) */
+#define FLOOD_USEC_PER_MSEC     1000ULL
+
+/* Forward declarations of private functions */
+static ospf_flood_pending_t *flood_slot(ospf_flood_tx_t *tx, ospf_flood_pending_t *slots, uint32_t dst);
+static status_t flood_queue_lsa(ospf_flood_tx_t *tx, uint32_t dst, const void *lsa, uint16_t length);
+static bool flood_drop_queued_lsa(ospf_flood_pending_t *slot, const uint8_t *lsa);
+static void flood_copy_lsa(const ospf_flood_tx_t *tx, uint8_t *to, const void *lsa, uint16_t length);
+static void flood_send(ospf_flood_tx_t *tx, uint8_t type, uint32_t dst, uint8_t *buf, uint16_t len, uint32_t count);
+static void flood_send_slot(ospf_flood_tx_t *tx, ospf_flood_pending_t *slot, uint8_t type);
+static void flood_arm(event_timer_t *timer, uint32_t delay_ms);
+static void flood_lsu_timer_cb(event_timer_t *timer, void *arg);
+static void flood_ack_timer_cb(event_timer_t *timer, void *arg);
+static uint16_t flood_checksum(const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Prepare the transmitter of an interface
+ *
+ * @param tx Transmitter
+ * @param config Parameters, copied
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER if the MTU
+ *         cannot hold one LSA header or send is missing
+ */
+status_t ospf_flood_init(ospf_flood_tx_t *tx, const ospf_flood_config_t *config) {
+    if (!tx || !config || !config->send ||
+        config->mtu < OSPF_FLOOD_IP_OVERHEAD + OSPF_FLOOD_HEADER_LEN + FLOOD_LSU_COUNT_LEN +
+                      OSPF_FLOOD_LSA_HEADER_LEN) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(tx, 0, sizeof(*tx));
+    tx->config = *config;
+    tx->flood_addr = OSPF_FLOOD_ALLSPFROUTERS;
+    tx->max_len = config->mtu - OSPF_FLOOD_IP_OVERHEAD;
+    event_timer_init(&tx->lsu_timer, flood_lsu_timer_cb, tx);
+    event_timer_init(&tx->ack_timer, flood_ack_timer_cb, tx);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Send everything pending and release the transmitter
+ *
+ * @param tx Transmitter
+ */
+void ospf_flood_destroy(ospf_flood_tx_t *tx) {
+    if (!tx) {
+        return;
+    }
+
+    ospf_flood_flush(tx);
+    (void)event_timer_stop(&tx->lsu_timer);
+    (void)event_timer_stop(&tx->ack_timer);
+    for (int i = 0; i < OSPF_FLOOD_MAX_DESTINATIONS; i++) {
+        free(tx->lsu[i].buf);
+        free(tx->ack[i].buf);
+        tx->lsu[i].buf = tx->ack[i].buf = NULL;
+    }
+}
+
+/**
+ * @brief Set where floods go, as the interface state changes
+ *
+ * Acks already delayed for the old address are sent to it first.
+ *
+ * @param tx Transmitter
+ * @param addr Flood address, host order
+ */
+void ospf_flood_set_flood_address(ospf_flood_tx_t *tx, uint32_t addr) {
+    if (tx->flood_addr == addr) {
+        return;
+    }
+
+    for (int i = 0; i < OSPF_FLOOD_MAX_DESTINATIONS; i++) {
+        if (tx->ack[i].len && tx->ack[i].dst == tx->flood_addr) {
+            flood_send_slot(tx, &tx->ack[i], FLOOD_TYPE_LS_ACK);
+        }
+    }
+    tx->flood_addr = addr;
+}
+
+/**
+ * @brief Flood an LSA on the interface, once for all its neighbors
+ *
+ * @param tx Transmitter
+ * @param lsa LSA, header included, network order
+ * @param length Bytes at lsa
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t ospf_flood_lsa(ospf_flood_tx_t *tx, const void *lsa, uint16_t length) {
+    if (!tx) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    return flood_queue_lsa(tx, tx->flood_addr, lsa, length);
+}
+
+/**
+ * @brief Send an LSA to one neighbor
+ *
+ * @param tx Transmitter
+ * @param dst Neighbor address, host order
+ * @param lsa LSA, header included, network order
+ * @param length Bytes at lsa
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY,
+ *         STATUS_RESOURCE_EXHAUSTED if too many destinations are pending
+ */
+status_t ospf_flood_send_lsa(ospf_flood_tx_t *tx, uint32_t dst, const void *lsa, uint16_t length) {
+    if (!tx) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    return flood_queue_lsa(tx, dst, lsa, length);
+}
+
+/**
+ * @brief Acknowledge an LSA
+ *
+ * @param tx Transmitter
+ * @param dst Neighbor address for a direct ack, host order; ignored if delayed
+ * @param lsa_header Header of the LSA, network order
+ * @param delayed true for a delayed ack (RFC 2328 13.5)
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY,
+ *         STATUS_RESOURCE_EXHAUSTED if too many destinations are pending
+ */
+status_t ospf_flood_ack(ospf_flood_tx_t *tx, uint32_t dst, const void *lsa_header, bool delayed) {
+    const uint8_t *hdr = (const uint8_t *)lsa_header;
+
+    if (!tx || !lsa_header) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (delayed) {
+        dst = tx->flood_addr;
+    }
+    ospf_flood_pending_t *slot = flood_slot(tx, tx->ack, dst);
+    if (!slot) {
+        return STATUS_RESOURCE_EXHAUSTED;
+    }
+    if (!slot->buf) {
+        slot->buf = malloc(tx->max_len);
+        if (!slot->buf) {
+            return STATUS_NO_MEMORY;
+        }
+    }
+
+    /* The same instance (type, ID, router, sequence) is acknowledged once */
+    for (uint16_t off = OSPF_FLOOD_HEADER_LEN; off < slot->len; off += OSPF_FLOOD_LSA_HEADER_LEN) {
+        if (memcmp(slot->buf + off + 3, hdr + 3, 13) == 0) {
+            tx->stats.coalesced++;
+            return STATUS_SUCCESS;
+        }
+    }
+
+    if (slot->len + OSPF_FLOOD_LSA_HEADER_LEN > tx->max_len) {
+        flood_send_slot(tx, slot, FLOOD_TYPE_LS_ACK);
+    }
+    if (slot->len == 0) {
+        slot->dst = dst;
+        slot->len = OSPF_FLOOD_HEADER_LEN;
+        if (delayed) {
+            if (!event_timer_pending(&tx->ack_timer)) {
+                flood_arm(&tx->ack_timer, tx->config.ack_delay_ms);
+            }
+        } else if (!event_timer_pending(&tx->lsu_timer)) {
+            flood_arm(&tx->lsu_timer, tx->config.pacing_ms);
+        }
+    }
+
+    memcpy(slot->buf + slot->len, hdr, OSPF_FLOOD_LSA_HEADER_LEN);
+    slot->len += OSPF_FLOOD_LSA_HEADER_LEN;
+    slot->count++;
+
+    /* Without a running event loop there is no timer to wait for */
+    if (!event_timer_pending(delayed ? &tx->ack_timer : &tx->lsu_timer)) {
+        flood_send_slot(tx, slot, FLOOD_TYPE_LS_ACK);
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Send every pending packet now
+ *
+ * @param tx Transmitter
+ */
+void ospf_flood_flush(ospf_flood_tx_t *tx) {
+    if (!tx) {
+        return;
+    }
+
+    for (int i = 0; i < OSPF_FLOOD_MAX_DESTINATIONS; i++) {
+        flood_send_slot(tx, &tx->lsu[i], FLOOD_TYPE_LS_UPDATE);
+        flood_send_slot(tx, &tx->ack[i], FLOOD_TYPE_LS_ACK);
+    }
+    (void)event_timer_stop(&tx->lsu_timer);
+    (void)event_timer_stop(&tx->ack_timer);
+}
+
+/**
+ * @brief Get transmitter counters
+ *
+ * @param tx Transmitter
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t ospf_flood_get_stats(const ospf_flood_tx_t *tx, ospf_flood_stats_t *stats) {
+    if (!tx || !stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    *stats = tx->stats;
+    return STATUS_SUCCESS;
+}
+
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/**
+ * @brief Get the packet under construction for a destination, or a free one
+ *
+ * @return Slot, NULL if every slot holds a packet for another destination
+ */
+static ospf_flood_pending_t *flood_slot(ospf_flood_tx_t *tx, ospf_flood_pending_t *slots, uint32_t dst) {
+    ospf_flood_pending_t *free_slot = NULL;
+    (void)tx;
+
+    for (int i = 0; i < OSPF_FLOOD_MAX_DESTINATIONS; i++) {
+        if (slots[i].len) {
+            if (slots[i].dst == dst) {
+                return &slots[i];
+            }
+        } else if (!free_slot || (!free_slot->buf && slots[i].buf)) {
+            /* Prefer a slot that already has its buffer */
+            free_slot = &slots[i];
+        }
+    }
+    return free_slot;
+}
+
+/**
+ * @brief Add an LSA to the update under construction for a destination
+ */
+static status_t flood_queue_lsa(ospf_flood_tx_t *tx, uint32_t dst, const void *lsa, uint16_t length) {
+    const uint16_t empty_len = OSPF_FLOOD_HEADER_LEN + FLOOD_LSU_COUNT_LEN;
+
+    if (!lsa || length < OSPF_FLOOD_LSA_HEADER_LEN) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (empty_len + length > tx->max_len) {
+        uint8_t *buf = malloc(empty_len + length);
+        if (!buf) {
+            return STATUS_NO_MEMORY;
+        }
+        flood_copy_lsa(tx, buf + empty_len, lsa, length);
+        flood_send(tx, FLOOD_TYPE_LS_UPDATE, dst, buf, empty_len + length, 1);
+        free(buf);
+        return STATUS_SUCCESS;
+    }
+
+    ospf_flood_pending_t *slot = flood_slot(tx, tx->lsu, dst);
+    if (!slot) {
+        return STATUS_RESOURCE_EXHAUSTED;
+    }
+    if (!slot->buf) {
+        slot->buf = malloc(tx->max_len);
+        if (!slot->buf) {
+            return STATUS_NO_MEMORY;
+        }
+    }
+
+    if (slot->len && flood_drop_queued_lsa(slot, (const uint8_t *)lsa)) {
+        tx->stats.coalesced++;
+    }
+    if (slot->len + length > tx->max_len) {
+        flood_send_slot(tx, slot, FLOOD_TYPE_LS_UPDATE);
+    }
+    if (slot->len == 0) {
+        slot->dst = dst;
+        slot->len = empty_len;
+        if (!event_timer_pending(&tx->lsu_timer)) {
+            flood_arm(&tx->lsu_timer, tx->config.pacing_ms);
+        }
+    }
+
+    flood_copy_lsa(tx, slot->buf + slot->len, lsa, length);
+    slot->len += length;
+    slot->count++;
+
+    if (!event_timer_pending(&tx->lsu_timer)) {
+        flood_send_slot(tx, slot, FLOOD_TYPE_LS_UPDATE);
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Remove a queued instance of the same LSA from an update
+ *
+ * @return true if an instance was removed
+ */
+static bool flood_drop_queued_lsa(ospf_flood_pending_t *slot, const uint8_t *lsa) {
+    uint16_t off = OSPF_FLOOD_HEADER_LEN + FLOOD_LSU_COUNT_LEN;
+
+    while (off + OSPF_FLOOD_LSA_HEADER_LEN <= slot->len) {
+        uint8_t *queued = slot->buf + off;
+        uint16_t queued_len;
+
+        memcpy(&queued_len, queued + 18, sizeof(queued_len));
+        queued_len = ntohs(queued_len);
+        if (queued_len < OSPF_FLOOD_LSA_HEADER_LEN || off + queued_len > slot->len) {
+            break;
+        }
+
+        /* Same LS type, Link State ID and Advertising Router */
+        if (memcmp(queued + 3, lsa + 3, 9) == 0) {
+            memmove(queued, queued + queued_len, slot->len - off - queued_len);
+            slot->len -= queued_len;
+            slot->count--;
+            return true;
+        }
+        off += queued_len;
+    }
+    return false;
+}
+
+/**
+ * @brief Copy an LSA into a packet, aging it by InfTransDelay
+ *
+ * The LS checksum does not cover the age, so it stays valid.
+ */
+static void flood_copy_lsa(const ospf_flood_tx_t *tx, uint8_t *to, const void *lsa, uint16_t length) {
+    uint16_t age;
+
+    memcpy(to, lsa, length);
+    memcpy(&age, to, sizeof(age));
+    age = ntohs(age);
+
+    uint16_t do_not_age = age & FLOOD_DO_NOT_AGE;
+    uint32_t aged = (uint32_t)(age & ~FLOOD_DO_NOT_AGE) + tx->config.transmit_delay;
+    if (aged > OSPF_LSDB_MAX_AGE) {
+        aged = OSPF_LSDB_MAX_AGE;
+    }
+    age = htons((uint16_t)(aged | do_not_age));
+    memcpy(to, &age, sizeof(age));
+}
+
+/**
+ * @brief Fill in the OSPF header of a finished packet and send it
+ */
+static void flood_send(ospf_flood_tx_t *tx, uint8_t type, uint32_t dst, uint8_t *buf, uint16_t len, uint32_t count) {
+    uint16_t len_n = htons(len);
+    uint32_t router_id = htonl(tx->config.router_id);
+    uint32_t area_id = htonl(tx->config.area_id);
+
+    memset(buf, 0, OSPF_FLOOD_HEADER_LEN);
+    buf[0] = FLOOD_OSPF_VERSION;
+    buf[1] = type;
+    memcpy(buf + 2, &len_n, sizeof(len_n));
+    memcpy(buf + 4, &router_id, sizeof(router_id));
+    memcpy(buf + 8, &area_id, sizeof(area_id));
+    if (type == FLOOD_TYPE_LS_UPDATE) {
+        uint32_t count_n = htonl(count);
+        memcpy(buf + OSPF_FLOOD_HEADER_LEN, &count_n, sizeof(count_n));
+    }
+
+    /* Null authentication: the checksum covers the whole packet */
+    uint16_t checksum = flood_checksum(buf, len);
+    memcpy(buf + 12, &checksum, sizeof(checksum));
+
+    if (tx->config.send(dst, buf, len, tx->config.ctx) != STATUS_SUCCESS) {
+        tx->stats.send_errors++;
+        return;
+    }
+
+    if (type == FLOOD_TYPE_LS_UPDATE) {
+        tx->stats.lsu_packets++;
+        tx->stats.lsas += count;
+    } else {
+        tx->stats.ack_packets++;
+        tx->stats.acks += count;
+    }
+}
+
+static void flood_send_slot(ospf_flood_tx_t *tx, ospf_flood_pending_t *slot, uint8_t type) {
+    if (!slot->len || !slot->count) {
+        slot->len = 0;
+        return;
+    }
+
+    flood_send(tx, type, slot->dst, slot->buf, slot->len, slot->count);
+    slot->len = 0;
+    slot->count = 0;
+}
+
+/**
+ * @brief Arm a one-shot timer; a zero delay or a stopped event loop leaves it idle
+ */
+static void flood_arm(event_timer_t *timer, uint32_t delay_ms) {
+    if (delay_ms) {
+        (void)event_timer_start(timer, (uint64_t)delay_ms * FLOOD_USEC_PER_MSEC, 0);
+    }
+}
+
+/**
+ * @brief End of the pacing window: updates and direct acks leave
+ */
+static void flood_lsu_timer_cb(event_timer_t *timer, void *arg) {
+    ospf_flood_tx_t *tx = (ospf_flood_tx_t *)arg;
+    (void)timer;
+
+    for (int i = 0; i < OSPF_FLOOD_MAX_DESTINATIONS; i++) {
+        flood_send_slot(tx, &tx->lsu[i], FLOOD_TYPE_LS_UPDATE);
+        if (tx->ack[i].len && tx->ack[i].dst != tx->flood_addr) {
+            flood_send_slot(tx, &tx->ack[i], FLOOD_TYPE_LS_ACK);
+        }
+    }
+}
+
+/**
+ * @brief End of the delayed-ack interval: every queued ack leaves
+ */
+static void flood_ack_timer_cb(event_timer_t *timer, void *arg) {
+    ospf_flood_tx_t *tx = (ospf_flood_tx_t *)arg;
+    (void)timer;
+
+    for (int i = 0; i < OSPF_FLOOD_MAX_DESTINATIONS; i++) {
+        flood_send_slot(tx, &tx->ack[i], FLOOD_TYPE_LS_ACK);
+    }
+}
+
+/**
+ * @brief Internet checksum, returned in network order
+ */
+static uint16_t flood_checksum(const uint8_t *data, uint16_t len) {
+    uint32_t sum = 0;
+
+    for (uint16_t i = 0; i + 1 < len; i += 2) {
+        sum += (uint32_t)(data[i] << 8 | data[i + 1]);
+    }
+    if (len & 1) {
+        sum += (uint32_t)data[len - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return htons((uint16_t)~sum);
+}
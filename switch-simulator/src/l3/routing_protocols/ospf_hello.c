@@ -0,0 +1,425 @@
+/**
+ * @file ospf_hello.c
+ * @brief Implementation of OSPF Hello transmission and neighbor inactivity
+ *
+ * The template is the whole Hello packet with its checksum, so a periodic
+ * Hello is one call to send. Anything that changes what the packet says
+ * only marks the template stale; it is rebuilt at the next Hello.
+ *
+ * An inactivity timer is armed for RouterDeadInterval when a neighbor is
+ * added and is never moved by the Hellos that follow. When it fires it
+ * compares the deadline of the last Hello with the clock and either
+ * re-arms for the remainder or drops the neighbor, so a neighbor costs
+ * one timer expiry per dead interval however often it says Hello.
+ */
+
+#include "l3/ospf_hello.h"
+#include <string.h>
+#include <arpa/inet.h>
+
+/* Defines */
+#define HELLO_OSPF_VERSION      2
+#define HELLO_TYPE_HELLO        1
+#define HELLO_USEC_PER_SEC      1000000ULL
+#define HELLO_MAX_JITTER_PCT    50
+
+/* Forward declarations of private functions */
+static ospf_hello_neighbor_t *hello_find(ospf_hello_iface_t *iface, uint32_t router_id);
+static void hello_drop(ospf_hello_iface_t *iface, ospf_hello_neighbor_t *nbr);
+static void hello_build(ospf_hello_iface_t *iface);
+static status_t hello_send(ospf_hello_iface_t *iface);
+static uint64_t hello_jitter(ospf_hello_iface_t *iface, uint64_t interval_us);
+static void hello_timer_cb(event_timer_t *timer, void *arg);
+static void hello_inactivity_timer_cb(event_timer_t *timer, void *arg);
+static uint16_t hello_checksum(const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Prepare the Hello state of an interface
+ *
+ * @param iface Interface
+ * @param config Parameters, copied
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER if send is
+ *         missing, an interval is zero, or the dead interval is not
+ *         longer than the Hello interval
+ */
+status_t ospf_hello_init(ospf_hello_iface_t *iface, const ospf_hello_config_t *config) {
+    if (!iface || !config || !config->send || config->hello_interval == 0 ||
+        config->dead_interval <= config->hello_interval || config->jitter_pct > HELLO_MAX_JITTER_PCT) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(iface, 0, sizeof(*iface));
+    iface->config = *config;
+    if (iface->config.dst == 0) {
+        iface->config.dst = OSPF_HELLO_ALLSPFROUTERS;
+    }
+    iface->template_stale = true;
+    /* Interfaces started in the same tick must still draw different phases */
+    iface->jitter_state = (uint32_t)(event_loop_now_us() ^ config->router_id ^
+                                     (uintptr_t)iface) | 1;
+    event_timer_init(&iface->hello_timer, hello_timer_cb, iface);
+    for (int i = 0; i < OSPF_HELLO_MAX_NEIGHBORS; i++) {
+        iface->neighbors[i].iface = iface;
+        event_timer_init(&iface->neighbors[i].inactivity_timer, hello_inactivity_timer_cb,
+                         &iface->neighbors[i]);
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Stop the timers and forget every neighbor
+ *
+ * @param iface Interface
+ */
+void ospf_hello_destroy(ospf_hello_iface_t *iface) {
+    if (!iface) {
+        return;
+    }
+
+    ospf_hello_stop(iface);
+    for (int i = 0; i < OSPF_HELLO_MAX_NEIGHBORS; i++) {
+        if (iface->neighbors[i].in_use) {
+            hello_drop(iface, &iface->neighbors[i]);
+        }
+    }
+}
+
+/**
+ * @brief Start sending Hellos
+ *
+ * @param iface Interface
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, or the error
+ *         of event_timer_start()
+ */
+status_t ospf_hello_start(ospf_hello_iface_t *iface) {
+    uint64_t window;
+    status_t status;
+
+    if (!iface) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (iface->running) {
+        return STATUS_SUCCESS;
+    }
+
+    /* A random phase within the jitter window, at least a tick */
+    window = (uint64_t)iface->config.hello_interval * HELLO_USEC_PER_SEC * iface->config.jitter_pct / 100;
+    status = event_timer_start(&iface->hello_timer, window ? 1 + hello_jitter(iface, window) % window : 0, 0);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    iface->running = true;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Stop sending Hellos; neighbors keep their inactivity timers
+ *
+ * @param iface Interface
+ */
+void ospf_hello_stop(ospf_hello_iface_t *iface) {
+    if (!iface) {
+        return;
+    }
+
+    (void)event_timer_stop(&iface->hello_timer);
+    iface->running = false;
+}
+
+/**
+ * @brief Send a Hello now
+ *
+ * @param iface Interface
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, or the error of send
+ */
+status_t ospf_hello_send_now(ospf_hello_iface_t *iface) {
+    if (!iface) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    return hello_send(iface);
+}
+
+/**
+ * @brief Set the DR and BDR the Hellos announce
+ *
+ * @param iface Interface
+ * @param dr Designated Router address, host order
+ * @param bdr Backup Designated Router address, host order
+ */
+void ospf_hello_set_dr(ospf_hello_iface_t *iface, uint32_t dr, uint32_t bdr) {
+    if (!iface || (iface->dr == dr && iface->bdr == bdr)) {
+        return;
+    }
+
+    iface->dr = dr;
+    iface->bdr = bdr;
+    iface->template_stale = true;
+}
+
+/**
+ * @brief Set the Router Priority the Hellos announce
+ *
+ * @param iface Interface
+ * @param priority Router Priority
+ */
+void ospf_hello_set_priority(ospf_hello_iface_t *iface, uint8_t priority) {
+    if (!iface || iface->config.priority == priority) {
+        return;
+    }
+
+    iface->config.priority = priority;
+    iface->template_stale = true;
+}
+
+/**
+ * @brief Record a Hello from a neighbor, adding the neighbor if it is new
+ *
+ * @param iface Interface
+ * @param router_id Router ID of the neighbor, host order
+ * @param neighbor_ip Source address of the Hello, host order
+ * @param[out] neighbor The neighbor; may be NULL
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER,
+ *         STATUS_RESOURCE_EXHAUSTED if the interface has no room for a new neighbor
+ */
+status_t ospf_hello_received(ospf_hello_iface_t *iface, uint32_t router_id, uint32_t neighbor_ip,
+                             ospf_hello_neighbor_t **neighbor) {
+    ospf_hello_neighbor_t *nbr;
+    status_t status;
+
+    if (!iface || router_id == 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    nbr = hello_find(iface, router_id);
+    if (nbr) {
+        nbr->neighbor_ip = neighbor_ip;
+        ospf_hello_neighbor_refresh(nbr);
+        if (neighbor) {
+            *neighbor = nbr;
+        }
+        return STATUS_SUCCESS;
+    }
+
+    for (int i = 0; i < OSPF_HELLO_MAX_NEIGHBORS && !nbr; i++) {
+        if (!iface->neighbors[i].in_use) {
+            nbr = &iface->neighbors[i];
+        }
+    }
+    if (!nbr) {
+        return STATUS_RESOURCE_EXHAUSTED;
+    }
+
+    status = event_timer_start(&nbr->inactivity_timer,
+                               (uint64_t)iface->config.dead_interval * HELLO_USEC_PER_SEC, 0);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    nbr->router_id = router_id;
+    nbr->neighbor_ip = neighbor_ip;
+    nbr->last_hello_us = event_loop_now_us();
+    nbr->in_use = true;
+    iface->neighbor_count++;
+    iface->template_stale = true;
+    if (neighbor) {
+        *neighbor = nbr;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Drop a neighbor
+ *
+ * @param iface Interface
+ * @param router_id Router ID of the neighbor, host order
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NOT_FOUND
+ */
+status_t ospf_hello_remove_neighbor(ospf_hello_iface_t *iface, uint32_t router_id) {
+    ospf_hello_neighbor_t *nbr;
+
+    if (!iface) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    nbr = hello_find(iface, router_id);
+    if (!nbr) {
+        return STATUS_NOT_FOUND;
+    }
+    hello_drop(iface, nbr);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get interface counters
+ *
+ * @param iface Interface
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t ospf_hello_get_stats(const ospf_hello_iface_t *iface, ospf_hello_stats_t *stats) {
+    if (!iface || !stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    *stats = iface->stats;
+    return STATUS_SUCCESS;
+}
+
+static ospf_hello_neighbor_t *hello_find(ospf_hello_iface_t *iface, uint32_t router_id) {
+    for (int i = 0; i < OSPF_HELLO_MAX_NEIGHBORS; i++) {
+        if (iface->neighbors[i].in_use && iface->neighbors[i].router_id == router_id) {
+            return &iface->neighbors[i];
+        }
+    }
+    return NULL;
+}
+
+static void hello_drop(ospf_hello_iface_t *iface, ospf_hello_neighbor_t *nbr) {
+    (void)event_timer_stop(&nbr->inactivity_timer);
+    nbr->in_use = false;
+    iface->neighbor_count--;
+    iface->template_stale = true;
+}
+
+/**
+ * @brief Rebuild the Hello packet, checksum included
+ */
+static void hello_build(ospf_hello_iface_t *iface) {
+    uint8_t *buf = iface->template;
+    uint8_t *body = buf + OSPF_HELLO_HEADER_LEN;
+    uint16_t len = OSPF_HELLO_HEADER_LEN + OSPF_HELLO_BODY_LEN;
+    uint32_t v32;
+    uint16_t v16;
+
+    memset(buf, 0, OSPF_HELLO_HEADER_LEN + OSPF_HELLO_BODY_LEN);
+    buf[0] = HELLO_OSPF_VERSION;
+    buf[1] = HELLO_TYPE_HELLO;
+    v32 = htonl(iface->config.router_id);
+    memcpy(buf + 4, &v32, sizeof(v32));
+    v32 = htonl(iface->config.area_id);
+    memcpy(buf + 8, &v32, sizeof(v32));
+
+    v32 = htonl(iface->config.network_mask);
+    memcpy(body, &v32, sizeof(v32));
+    v16 = htons(iface->config.hello_interval);
+    memcpy(body + 4, &v16, sizeof(v16));
+    body[6] = iface->config.options;
+    body[7] = iface->config.priority;
+    v32 = htonl(iface->config.dead_interval);
+    memcpy(body + 8, &v32, sizeof(v32));
+    v32 = htonl(iface->dr);
+    memcpy(body + 12, &v32, sizeof(v32));
+    v32 = htonl(iface->bdr);
+    memcpy(body + 16, &v32, sizeof(v32));
+
+    for (int i = 0; i < OSPF_HELLO_MAX_NEIGHBORS; i++) {
+        if (iface->neighbors[i].in_use) {
+            v32 = htonl(iface->neighbors[i].router_id);
+            memcpy(buf + len, &v32, sizeof(v32));
+            len += sizeof(v32);
+        }
+    }
+
+    v16 = htons(len);
+    memcpy(buf + 2, &v16, sizeof(v16));
+    /* Null authentication: the checksum covers the whole packet */
+    v16 = hello_checksum(buf, len);
+    memcpy(buf + 12, &v16, sizeof(v16));
+
+    iface->template_len = len;
+    iface->template_stale = false;
+    iface->stats.template_builds++;
+}
+
+static status_t hello_send(ospf_hello_iface_t *iface) {
+    status_t status;
+
+    if (iface->template_stale) {
+        hello_build(iface);
+    }
+
+    status = iface->config.send(iface->config.dst, iface->template, iface->template_len, iface->config.ctx);
+    if (status != STATUS_SUCCESS) {
+        iface->stats.send_errors++;
+        return status;
+    }
+    iface->stats.hellos_sent++;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Random offset below interval_us (xorshift32)
+ */
+static uint64_t hello_jitter(ospf_hello_iface_t *iface, uint64_t interval_us) {
+    uint32_t x = iface->jitter_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    iface->jitter_state = x;
+
+    return interval_us ? x % interval_us : 0;
+}
+
+/**
+ * @brief HelloInterval elapsed: send and re-arm with fresh jitter
+ *
+ * Jitter only shortens the interval, so neighbors never see Hellos
+ * further apart than the HelloInterval the packet announces.
+ */
+static void hello_timer_cb(event_timer_t *timer, void *arg) {
+    ospf_hello_iface_t *iface = (ospf_hello_iface_t *)arg;
+    uint64_t interval = (uint64_t)iface->config.hello_interval * HELLO_USEC_PER_SEC;
+    uint64_t window = interval * iface->config.jitter_pct / 100;
+
+    (void)hello_send(iface);
+    if (iface->running) {
+        (void)event_timer_start(timer, interval - hello_jitter(iface, window), 0);
+    }
+}
+
+/**
+ * @brief Inactivity deadline reached: re-arm if a Hello came since, else drop
+ */
+static void hello_inactivity_timer_cb(event_timer_t *timer, void *arg) {
+    ospf_hello_neighbor_t *nbr = (ospf_hello_neighbor_t *)arg;
+    ospf_hello_iface_t *iface = nbr->iface;
+    uint64_t dead = (uint64_t)iface->config.dead_interval * HELLO_USEC_PER_SEC;
+    uint64_t deadline = nbr->last_hello_us + dead;
+    uint64_t now = event_loop_now_us();
+    uint32_t router_id = nbr->router_id;
+    uint32_t neighbor_ip = nbr->neighbor_ip;
+
+    if (!nbr->in_use) {
+        return;
+    }
+    if (now < deadline) {
+        iface->stats.inactivity_rearms++;
+        (void)event_timer_start(timer, deadline - now, 0);
+        return;
+    }
+
+    hello_drop(iface, nbr);
+    iface->stats.neighbors_dead++;
+    if (iface->config.dead) {
+        iface->config.dead(router_id, neighbor_ip, iface->config.ctx);
+    }
+}
+
+/**
+ * @brief Internet checksum, returned in network order
+ */
+static uint16_t hello_checksum(const uint8_t *data, uint16_t len) {
+    uint32_t sum = 0;
+
+    for (uint16_t i = 0; i + 1 < len; i += 2) {
+        sum += (uint32_t)(data[i] << 8 | data[i + 1]);
+    }
+    if (len & 1) {
+        sum += (uint32_t)data[len - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return htons((uint16_t)~sum);
+}
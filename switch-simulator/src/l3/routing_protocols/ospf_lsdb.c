@@ -0,0 +1,440 @@
+/**
+ * @file ospf_lsdb.c
+ * @brief Implementation of the hashed OSPF link state database
+ *
+ * LSAs are chained in a hash table that doubles when it is full, and
+ * linked into the timing wheel bucket of their deadline. The wheel has
+ * more slots than MaxAge has seconds, so a bucket only ever holds the
+ * LSAs of a single second; a catch-up after a long stall visits every
+ * bucket once and keeps what is not due yet.
+ */
+
+#include "l3/ospf_lsdb.h"
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+/* Defines */
+#define LSDB_HEADER_LEN         20
+#define LSDB_INITIAL_BUCKETS    256
+#define LSDB_WHEEL_SIZE         4096    /* Seconds, a power of two above MaxAge */
+#define LSDB_WHEEL_MASK         (LSDB_WHEEL_SIZE - 1)
+
+/* Where an entry is linked on the wheel side */
+enum {
+    LSDB_WHEEL_QUEUED = 1,          /* In the bucket of its deadline */
+    LSDB_WHEEL_HELD,                /* Set aside while its bucket is visited */
+    LSDB_WHEEL_PARKED               /* Deadline reported, in no list */
+};
+
+/* Private data types */
+
+/* Database of one area */
+struct ospf_lsdb {
+    uint32_t router_id;
+    ospf_lsdb_entry_t **buckets;
+    uint32_t bucket_mask;
+    uint32_t count;
+    ospf_lsdb_entry_t *wheel[LSDB_WHEEL_SIZE];
+    ospf_lsdb_entry_t *held;        /* Entries of the visited bucket that are not due */
+    uint32_t next_tick;             /* First second not aged yet */
+    const ospf_lsdb_entry_t *current; /* Entry being reported, NULL once removed */
+};
+
+/* Forward declarations of private functions */
+static uint32_t lsdb_hash(uint8_t ls_type, uint32_t ls_id, uint32_t adv_router);
+static ospf_lsdb_entry_t **lsdb_slot(const ospf_lsdb_t *db, uint8_t ls_type, uint32_t ls_id, uint32_t adv_router);
+static bool lsdb_grow(ospf_lsdb_t *db);
+static void lsdb_link(ospf_lsdb_entry_t **head, ospf_lsdb_entry_t *entry);
+static void lsdb_unlink(ospf_lsdb_t *db, ospf_lsdb_entry_t *entry);
+static void lsdb_schedule(ospf_lsdb_t *db, ospf_lsdb_entry_t *entry, uint32_t deadline);
+static bool lsdb_due(uint32_t deadline, uint32_t now);
+
+/**
+ * @brief Create an empty database
+ *
+ * @param router_id Router ID of this router; its LSAs are refreshed
+ * @param now Current time, seconds
+ * @return New database, or NULL if out of memory
+ */
+ospf_lsdb_t *ospf_lsdb_create(uint32_t router_id, uint32_t now) {
+    ospf_lsdb_t *db = calloc(1, sizeof(*db));
+    if (!db) {
+        return NULL;
+    }
+
+    db->buckets = calloc(LSDB_INITIAL_BUCKETS, sizeof(*db->buckets));
+    if (!db->buckets) {
+        free(db);
+        return NULL;
+    }
+    db->bucket_mask = LSDB_INITIAL_BUCKETS - 1;
+    db->router_id = router_id;
+    db->next_tick = now;
+    return db;
+}
+
+/**
+ * @brief Free a database and its LSAs
+ *
+ * @param db Database, may be NULL
+ */
+void ospf_lsdb_destroy(ospf_lsdb_t *db) {
+    if (!db) {
+        return;
+    }
+
+    for (uint32_t i = 0; i <= db->bucket_mask; i++) {
+        ospf_lsdb_entry_t *entry = db->buckets[i];
+        while (entry) {
+            ospf_lsdb_entry_t *next = entry->hash_next;
+            free(entry->data);
+            free(entry);
+            entry = next;
+        }
+    }
+    free(db->buckets);
+    free(db);
+}
+
+/**
+ * @brief Install an LSA, replacing the instance with the same triple
+ *
+ * A replaced instance keeps its entry, so pointers to it stay valid.
+ *
+ * @param db Database
+ * @param lsa LSA, header included
+ * @param length Bytes at lsa, at least the 20-byte header
+ * @param now Current time, seconds
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t ospf_lsdb_install(ospf_lsdb_t *db, const void *lsa, uint16_t length, uint32_t now) {
+    const uint8_t *hdr = (const uint8_t *)lsa;
+    uint16_t age, checksum;
+    uint32_t ls_id, adv_router, seq;
+
+    if (!db || !lsa || length < LSDB_HEADER_LEN) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memcpy(&age, hdr, sizeof(age));
+    memcpy(&ls_id, hdr + 4, sizeof(ls_id));
+    memcpy(&adv_router, hdr + 8, sizeof(adv_router));
+    memcpy(&seq, hdr + 12, sizeof(seq));
+    memcpy(&checksum, hdr + 16, sizeof(checksum));
+    age = ntohs(age);
+    ls_id = ntohl(ls_id);
+    adv_router = ntohl(adv_router);
+
+    uint8_t *data = malloc(length);
+    if (!data) {
+        return STATUS_NO_MEMORY;
+    }
+    memcpy(data, lsa, length);
+
+    ospf_lsdb_entry_t **slot = lsdb_slot(db, hdr[3], ls_id, adv_router);
+    ospf_lsdb_entry_t *entry = *slot;
+    if (!entry) {
+        if (db->count > db->bucket_mask && lsdb_grow(db)) {
+            slot = lsdb_slot(db, hdr[3], ls_id, adv_router);
+        }
+        entry = calloc(1, sizeof(*entry));
+        if (!entry) {
+            free(data);
+            return STATUS_NO_MEMORY;
+        }
+        entry->ls_type = hdr[3];
+        entry->ls_id = ls_id;
+        entry->adv_router = adv_router;
+        *slot = entry;
+        db->count++;
+    } else {
+        lsdb_unlink(db, entry);
+        free(entry->data);
+    }
+
+    entry->seq = ntohl(seq);
+    entry->checksum = ntohs(checksum);
+    entry->length = length;
+    entry->data = data;
+    entry->install_age = age < OSPF_LSDB_MAX_AGE ? age : OSPF_LSDB_MAX_AGE;
+    entry->install_time = now;
+
+    /* Own LSAs are next due for refresh, the others for MaxAge */
+    uint32_t due = OSPF_LSDB_MAX_AGE;
+    if (adv_router == db->router_id && entry->install_age < OSPF_LSDB_REFRESH_TIME) {
+        due = OSPF_LSDB_REFRESH_TIME;
+    }
+    lsdb_schedule(db, entry, now + (due > entry->install_age ? due - entry->install_age : 0));
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Find an LSA by its triple
+ *
+ * @param db Database
+ * @param ls_type LS type
+ * @param ls_id Link State ID, host order
+ * @param adv_router Advertising Router, host order
+ * @return The LSA, NULL if not installed; valid until it is removed
+ */
+const ospf_lsdb_entry_t *ospf_lsdb_lookup(const ospf_lsdb_t *db, uint8_t ls_type,
+                                          uint32_t ls_id, uint32_t adv_router) {
+    if (!db) {
+        return NULL;
+    }
+    return *lsdb_slot(db, ls_type, ls_id, adv_router);
+}
+
+/**
+ * @brief Remove an LSA
+ *
+ * @param db Database
+ * @param ls_type LS type
+ * @param ls_id Link State ID, host order
+ * @param adv_router Advertising Router, host order
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if not installed
+ */
+status_t ospf_lsdb_remove(ospf_lsdb_t *db, uint8_t ls_type, uint32_t ls_id, uint32_t adv_router) {
+    if (!db) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    ospf_lsdb_entry_t **slot = lsdb_slot(db, ls_type, ls_id, adv_router);
+    ospf_lsdb_entry_t *entry = *slot;
+    if (!entry) {
+        return STATUS_NOT_FOUND;
+    }
+
+    *slot = entry->hash_next;
+    lsdb_unlink(db, entry);
+    if (db->current == entry) {
+        db->current = NULL;
+    }
+    db->count--;
+    free(entry->data);
+    free(entry);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Current LS age of an LSA
+ *
+ * @param entry LSA
+ * @param now Current time, seconds
+ * @return Age in seconds, at most OSPF_LSDB_MAX_AGE
+ */
+uint16_t ospf_lsdb_entry_age(const ospf_lsdb_entry_t *entry, uint32_t now) {
+    uint32_t age = entry->install_age + (now - entry->install_time);
+    return age < OSPF_LSDB_MAX_AGE ? (uint16_t)age : OSPF_LSDB_MAX_AGE;
+}
+
+/**
+ * @brief Report the aging deadlines passed since the last call
+ *
+ * @param db Database
+ * @param now Current time, seconds
+ * @param cb Called for each deadline, may be NULL
+ * @param ctx Passed to cb
+ * @return Number of deadlines reported
+ */
+uint32_t ospf_lsdb_age(ospf_lsdb_t *db, uint32_t now, ospf_lsdb_age_cb_t cb, void *ctx) {
+    uint32_t reported = 0;
+
+    if (!db || !lsdb_due(db->next_tick, now)) {
+        return 0;
+    }
+
+    /* After a stall every bucket is visited once */
+    uint32_t ticks = now - db->next_tick + 1;
+    if (ticks > LSDB_WHEEL_SIZE) {
+        ticks = LSDB_WHEEL_SIZE;
+    }
+    uint32_t tick = now - ticks + 1;
+    db->next_tick = now + 1;
+
+    for (uint32_t t = 0; t < ticks; t++, tick++) {
+        ospf_lsdb_entry_t **bucket = &db->wheel[tick & LSDB_WHEEL_MASK];
+        ospf_lsdb_entry_t *entry;
+
+        while ((entry = *bucket) != NULL) {
+            lsdb_unlink(db, entry);
+            if (!lsdb_due(entry->deadline, now)) {
+                lsdb_link(&db->held, entry);
+                entry->wheel_state = LSDB_WHEEL_HELD;
+                continue;
+            }
+
+            ospf_lsdb_event_t event = ospf_lsdb_entry_age(entry, now) >= OSPF_LSDB_MAX_AGE ?
+                                      OSPF_LSDB_EVENT_MAX_AGE : OSPF_LSDB_EVENT_REFRESH;
+            entry->wheel_state = LSDB_WHEEL_PARKED;
+            db->current = entry;
+            if (cb) {
+                cb(db, entry, event, ctx);
+            }
+            reported++;
+
+            /* A refresh nobody acted on still ends at MaxAge */
+            if (db->current && entry->wheel_state == LSDB_WHEEL_PARKED && event == OSPF_LSDB_EVENT_REFRESH) {
+                lsdb_schedule(db, entry,
+                              entry->install_time + (OSPF_LSDB_MAX_AGE - entry->install_age));
+            }
+            db->current = NULL;
+        }
+
+        while ((entry = db->held) != NULL) {
+            lsdb_unlink(db, entry);
+            lsdb_link(bucket, entry);
+            entry->wheel_state = LSDB_WHEEL_QUEUED;
+        }
+    }
+
+    return reported;
+}
+
+/**
+ * @brief Visit every LSA, in no particular order
+ *
+ * @param db Database
+ * @param cb Called for each LSA
+ * @param ctx Passed to cb
+ */
+void ospf_lsdb_foreach(const ospf_lsdb_t *db, ospf_lsdb_walk_cb_t cb, void *ctx) {
+    if (!db || !cb) {
+        return;
+    }
+
+    for (uint32_t i = 0; i <= db->bucket_mask; i++) {
+        for (const ospf_lsdb_entry_t *entry = db->buckets[i]; entry; entry = entry->hash_next) {
+            if (!cb(entry, ctx)) {
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Number of LSAs installed
+ *
+ * @param db Database
+ * @return LSA count
+ */
+uint32_t ospf_lsdb_count(const ospf_lsdb_t *db) {
+    return db ? db->count : 0;
+}
+
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/**
+ * @brief Hash an LSA triple
+ */
+static uint32_t lsdb_hash(uint8_t ls_type, uint32_t ls_id, uint32_t adv_router) {
+    uint64_t key = ((uint64_t)ls_id << 32) | adv_router;
+    key ^= (uint64_t)ls_type * 0x9e3779b97f4a7c15ULL;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (uint32_t)key;
+}
+
+/**
+ * @brief Find the chain link that holds, or would hold, an LSA
+ *
+ * @return Pointer to the link; *link is NULL if the LSA is not installed
+ */
+static ospf_lsdb_entry_t **lsdb_slot(const ospf_lsdb_t *db, uint8_t ls_type, uint32_t ls_id, uint32_t adv_router) {
+    ospf_lsdb_entry_t **link = &db->buckets[lsdb_hash(ls_type, ls_id, adv_router) & db->bucket_mask];
+    while (*link && ((*link)->ls_type != ls_type || (*link)->ls_id != ls_id || (*link)->adv_router != adv_router)) {
+        link = &(*link)->hash_next;
+    }
+    return link;
+}
+
+/**
+ * @brief Double the hash table
+ *
+ * @return false if out of memory; the table keeps working, only slower
+ */
+static bool lsdb_grow(ospf_lsdb_t *db) {
+    uint32_t size = (db->bucket_mask + 1) * 2;
+    ospf_lsdb_entry_t **buckets = calloc(size, sizeof(*buckets));
+    if (!buckets) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i <= db->bucket_mask; i++) {
+        ospf_lsdb_entry_t *entry = db->buckets[i];
+        while (entry) {
+            ospf_lsdb_entry_t *next = entry->hash_next;
+            uint32_t b = lsdb_hash(entry->ls_type, entry->ls_id, entry->adv_router) & (size - 1);
+            entry->hash_next = buckets[b];
+            buckets[b] = entry;
+            entry = next;
+        }
+    }
+
+    free(db->buckets);
+    db->buckets = buckets;
+    db->bucket_mask = size - 1;
+    return true;
+}
+
+/**
+ * @brief Push an entry at the head of a wheel list
+ */
+static void lsdb_link(ospf_lsdb_entry_t **head, ospf_lsdb_entry_t *entry) {
+    entry->wheel_prev = NULL;
+    entry->wheel_next = *head;
+    if (*head) {
+        (*head)->wheel_prev = entry;
+    }
+    *head = entry;
+}
+
+/**
+ * @brief Take an entry out of whichever wheel list holds it
+ */
+static void lsdb_unlink(ospf_lsdb_t *db, ospf_lsdb_entry_t *entry) {
+    ospf_lsdb_entry_t **head;
+
+    if (entry->wheel_state == LSDB_WHEEL_QUEUED) {
+        head = &db->wheel[entry->deadline & LSDB_WHEEL_MASK];
+    } else if (entry->wheel_state == LSDB_WHEEL_HELD) {
+        head = &db->held;
+    } else {
+        return;
+    }
+
+    if (entry->wheel_prev) {
+        entry->wheel_prev->wheel_next = entry->wheel_next;
+    } else {
+        *head = entry->wheel_next;
+    }
+    if (entry->wheel_next) {
+        entry->wheel_next->wheel_prev = entry->wheel_prev;
+    }
+    entry->wheel_prev = entry->wheel_next = NULL;
+    entry->wheel_state = 0;
+}
+
+/**
+ * @brief Queue an entry for its next deadline
+ *
+ * Deadlines already behind the wheel are moved to the next second aged.
+ */
+static void lsdb_schedule(ospf_lsdb_t *db, ospf_lsdb_entry_t *entry, uint32_t deadline) {
+    lsdb_unlink(db, entry);
+    if (lsdb_due(deadline, db->next_tick - 1)) {
+        deadline = db->next_tick;
+    }
+    entry->deadline = deadline;
+    lsdb_link(&db->wheel[deadline & LSDB_WHEEL_MASK], entry);
+    entry->wheel_state = LSDB_WHEEL_QUEUED;
+}
+
+/**
+ * @brief Check whether a second has come, with wrap-around
+ */
+static bool lsdb_due(uint32_t deadline, uint32_t now) {
+    return (int32_t)(deadline - now) <= 0;
+}
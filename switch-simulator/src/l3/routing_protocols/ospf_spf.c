@@ -0,0 +1,1135 @@
+/**
+ * @file ospf_spf.c
+ * @brief Implementation of the OSPF shortest path first engine
+ *
+ * Vertices and prefixes live in growable arrays and are found through
+ * open-addressing hash indexes; edges and prefix origins refer to them by
+ * array index, so a run never hashes. Dijkstra keeps its candidate list in
+ * a binary heap with a position index for decrease-key, which makes one
+ * run O((V + E) log V) instead of the O(V^2) of a linear candidate scan.
+ *
+ * Between runs the engine remembers what the changes can have touched.
+ * Every prefix whose origins changed is queued for the route calculation.
+ * A transit link change marks the tree stale only if the link is tight,
+ * i.e. lies on a shortest path now or would tie or beat one; a link
+ * nobody's path uses can come and go without moving the tree.
+ *
+ * Loop-free alternates need the shortest distances from each neighbor of
+ * the root as well. They are computed by one more Dijkstra per neighbor,
+ * with scratch arrays of their own, whenever any transit link changed;
+ * the prefixes are only recalculated if the neighbors or their distances
+ * came out different.
+ */
+
+#include "l3/ospf_spf.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Defines */
+#define SPF_INITIAL_CAPACITY    64
+#define SPF_NOT_QUEUED          0xFFFFFFFFu     /* heap_pos of a vertex outside the heap */
+#define SPF_SETTLED             0xFFFFFFFEu     /* heap_pos of a vertex taken from the heap */
+#define SPF_ROOT                0               /* Index of the root vertex */
+
+#define SPF_VERTEX_KEY(type, id) (((uint64_t)(type) << 32) | (uint32_t)(id))
+#define SPF_PREFIX_KEY(addr, len) (((uint64_t)(addr) << 8) | (uint8_t)(len))
+#define SPF_KEY_TYPE(key)       ((ospf_spf_vertex_type_t)((key) >> 32))
+#define SPF_KEY_ID(key)         ((uint32_t)(key))
+
+/* Private data types */
+
+/* Transit edge to another vertex */
+typedef struct {
+    uint32_t to;                    /* Vertex index */
+    uint32_t metric;
+} spf_edge_t;
+
+/* Vertex or prefix paired with the metric between them */
+typedef struct {
+    uint32_t index;
+    uint32_t metric;
+} spf_ref_t;
+
+/* Router or network vertex */
+typedef struct {
+    uint64_t key;                   /* Type and ID; must stay first for the index */
+    spf_edge_t *edges;
+    uint32_t edge_count;
+    spf_ref_t *prefixes;            /* Prefixes reached through the vertex */
+    uint32_t prefix_count;
+    uint32_t dist;                  /* Distance from the root after the last Dijkstra */
+    uint32_t heap_pos;
+    uint8_t nh_count;
+    uint32_t nh[OSPF_SPF_MAX_PATHS]; /* First-hop vertex indices */
+} spf_vertex_t;
+
+/* Prefix with the vertices that reach it */
+typedef struct {
+    uint64_t key;                   /* Address and length; must stay first for the index */
+    spf_ref_t *origins;
+    uint32_t origin_count;
+    uint32_t origin_cap;
+    bool dirty;
+    ospf_spf_route_t route;         /* Route reported last */
+} spf_prefix_t;
+
+/* Open-addressing index from key to array position */
+typedef struct {
+    uint32_t *slots;                /* Position + 1, 0 if empty */
+    uint32_t mask;
+} spf_index_t;
+
+/* Engine of one area */
+struct ospf_spf {
+    spf_vertex_t *vertices;
+    uint32_t vertex_count;
+    uint32_t vertex_cap;
+    spf_index_t vertex_index;
+
+    spf_prefix_t *prefixes;
+    uint32_t prefix_count;
+    uint32_t prefix_cap;
+    spf_index_t prefix_index;
+
+    uint32_t *dirty;                /* Prefixes waiting for the route calculation */
+    uint32_t dirty_count;
+    uint32_t dirty_cap;
+    bool tree_stale;                /* Dijkstra must run before the routes */
+
+    uint32_t *heap;                 /* Vertex indices, Dijkstra candidates */
+    uint32_t heap_size;
+    uint32_t heap_cap;
+
+    uint32_t *lfa_nbrs;             /* Router vertices one link from the root */
+    uint32_t lfa_count;
+    uint32_t *lfa_dist;             /* lfa_count rows of lfa_vertices distances, one per neighbor */
+    uint32_t lfa_vertices;          /* Vertices when the distances were computed */
+    uint32_t *lfa_heap;             /* Scratch of the neighbors' Dijkstra */
+    uint32_t *lfa_pos;
+    uint32_t lfa_scratch_cap;
+    bool lfa_stale;                 /* The neighbors' distances must be recomputed */
+
+    ospf_spf_stats_t stats;
+};
+
+/* Forward declarations of private functions */
+static uint32_t spf_hash(uint64_t key);
+static status_t spf_index_init(spf_index_t *index, uint32_t cap);
+static uint32_t spf_index_find(const spf_index_t *index, uint64_t key, const void *base, size_t stride);
+static status_t spf_index_insert(spf_index_t *index, uint64_t key, uint32_t pos,
+                                 const void *base, size_t stride, uint32_t count);
+static bool spf_grow(void **array, uint32_t *cap, uint32_t need, size_t size);
+static uint32_t spf_vertex_get(ospf_spf_t *spf, uint64_t key);
+static uint32_t spf_prefix_get(ospf_spf_t *spf, uint32_t addr, uint8_t prefix_len);
+static void spf_prefix_mark(ospf_spf_t *spf, uint32_t prefix);
+static uint32_t spf_edge_metric(const spf_vertex_t *from, uint32_t to);
+static bool spf_edge_tight(const ospf_spf_t *spf, uint32_t from, uint32_t to, uint32_t metric);
+static void spf_note_link_change(ospf_spf_t *spf, uint32_t from, uint32_t to, uint32_t metric);
+static bool spf_heap_less(const ospf_spf_t *spf, uint32_t a, uint32_t b);
+static void spf_heap_up(ospf_spf_t *spf, uint32_t pos);
+static void spf_heap_down(ospf_spf_t *spf, uint32_t pos);
+static void spf_dijkstra(ospf_spf_t *spf);
+static void spf_dist_up(uint32_t *heap, uint32_t *pos, const uint32_t *dist, uint32_t at);
+static void spf_dist_down(uint32_t *heap, uint32_t *pos, const uint32_t *dist, uint32_t size, uint32_t at);
+static void spf_distances(ospf_spf_t *spf, uint32_t source, uint32_t *dist);
+static status_t spf_lfa_update(ospf_spf_t *spf, bool *changed);
+static void spf_lfa_compute(const ospf_spf_t *spf, const spf_prefix_t *prefix, ospf_spf_route_t *route);
+static bool spf_route_compute(const ospf_spf_t *spf, const spf_prefix_t *prefix, ospf_spf_route_t *route);
+static uint64_t spf_now_us(void);
+
+/**
+ * @brief Create the engine of an area
+ *
+ * @param root_id Router ID of this router, the root of the tree
+ * @return New engine, or NULL if out of memory
+ */
+ospf_spf_t *ospf_spf_create(uint32_t root_id) {
+    ospf_spf_t *spf = calloc(1, sizeof(*spf));
+    if (!spf) {
+        return NULL;
+    }
+
+    if (spf_index_init(&spf->vertex_index, SPF_INITIAL_CAPACITY * 2) != STATUS_SUCCESS ||
+        spf_index_init(&spf->prefix_index, SPF_INITIAL_CAPACITY * 2) != STATUS_SUCCESS ||
+        spf_vertex_get(spf, SPF_VERTEX_KEY(OSPF_SPF_VERTEX_ROUTER, root_id)) != SPF_ROOT) {
+        ospf_spf_destroy(spf);
+        return NULL;
+    }
+
+    spf->tree_stale = true;
+    return spf;
+}
+
+/**
+ * @brief Free an engine
+ *
+ * @param spf Engine, may be NULL
+ */
+void ospf_spf_destroy(ospf_spf_t *spf) {
+    if (!spf) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < spf->vertex_count; i++) {
+        free(spf->vertices[i].edges);
+        free(spf->vertices[i].prefixes);
+    }
+    for (uint32_t i = 0; i < spf->prefix_count; i++) {
+        free(spf->prefixes[i].origins);
+    }
+    free(spf->vertices);
+    free(spf->prefixes);
+    free(spf->vertex_index.slots);
+    free(spf->prefix_index.slots);
+    free(spf->dirty);
+    free(spf->heap);
+    free(spf->lfa_nbrs);
+    free(spf->lfa_dist);
+    free(spf->lfa_heap);
+    free(spf->lfa_pos);
+    free(spf);
+}
+
+/**
+ * @brief Replace the transit links of a vertex
+ *
+ * Each link that appears, disappears or changes cost is checked against
+ * the current tree in both directions, since the far end's link back to
+ * this vertex only counts while this one exists.
+ *
+ * @param spf Engine
+ * @param type Vertex type
+ * @param id Vertex ID
+ * @param links Links, NULL if count is 0
+ * @param count Number of links
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t ospf_spf_set_links(ospf_spf_t *spf, ospf_spf_vertex_type_t type, uint32_t id,
+                            const ospf_spf_link_t *links, uint32_t count) {
+    if (!spf || (count > 0 && !links)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    uint32_t u = spf_vertex_get(spf, SPF_VERTEX_KEY(type, id));
+    if (u == SPF_NOT_QUEUED) {
+        return STATUS_NO_MEMORY;
+    }
+
+    spf_edge_t *edges = NULL;
+    if (count > 0) {
+        edges = malloc(count * sizeof(*edges));
+        if (!edges) {
+            return STATUS_NO_MEMORY;
+        }
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        edges[i].to = spf_vertex_get(spf, SPF_VERTEX_KEY(links[i].type, links[i].id));
+        edges[i].metric = links[i].metric;
+        if (edges[i].to == SPF_NOT_QUEUED) {
+            free(edges);
+            return STATUS_NO_MEMORY;
+        }
+    }
+
+    spf_vertex_t *v = &spf->vertices[u];
+    if (!spf->tree_stale) {
+        /* Links that went away or changed, judged by the old cost */
+        for (uint32_t i = 0; i < v->edge_count && !spf->tree_stale; i++) {
+            bool kept = false;
+            for (uint32_t j = 0; j < count; j++) {
+                if (edges[j].to == v->edges[i].to && edges[j].metric == v->edges[i].metric) {
+                    kept = true;
+                    break;
+                }
+            }
+            if (!kept) {
+                spf_note_link_change(spf, u, v->edges[i].to, v->edges[i].metric);
+            }
+        }
+        /* Links that appeared or changed, judged by the new cost */
+        for (uint32_t j = 0; j < count && !spf->tree_stale; j++) {
+            if (spf_edge_metric(v, edges[j].to) != edges[j].metric) {
+                spf_note_link_change(spf, u, edges[j].to, edges[j].metric);
+            }
+        }
+    }
+
+    free(v->edges);
+    v->edges = edges;
+    v->edge_count = count;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Replace the prefixes reached through a vertex
+ *
+ * Only the prefixes named before or after the change are recalculated.
+ *
+ * @param spf Engine
+ * @param type Vertex type
+ * @param id Vertex ID
+ * @param prefixes Prefixes, NULL if count is 0
+ * @param count Number of prefixes
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t ospf_spf_set_prefixes(ospf_spf_t *spf, ospf_spf_vertex_type_t type, uint32_t id,
+                               const ospf_spf_prefix_t *prefixes, uint32_t count) {
+    if (!spf || (count > 0 && !prefixes)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (prefixes[i].prefix_len > 32) {
+            return STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    uint32_t u = spf_vertex_get(spf, SPF_VERTEX_KEY(type, id));
+    if (u == SPF_NOT_QUEUED) {
+        return STATUS_NO_MEMORY;
+    }
+
+    spf_ref_t *refs = NULL;
+    if (count > 0) {
+        refs = malloc(count * sizeof(*refs));
+        if (!refs) {
+            return STATUS_NO_MEMORY;
+        }
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t mask = prefixes[i].prefix_len ? 0xFFFFFFFFu << (32 - prefixes[i].prefix_len) : 0;
+        refs[i].index = spf_prefix_get(spf, prefixes[i].addr & mask, prefixes[i].prefix_len);
+        refs[i].metric = prefixes[i].metric;
+        if (refs[i].index == SPF_NOT_QUEUED) {
+            free(refs);
+            return STATUS_NO_MEMORY;
+        }
+    }
+
+    /* Withdraw the old origins, then add the new ones */
+    spf_vertex_t *v = &spf->vertices[u];
+    for (uint32_t i = 0; i < v->prefix_count; i++) {
+        spf_prefix_t *p = &spf->prefixes[v->prefixes[i].index];
+        for (uint32_t j = 0; j < p->origin_count; j++) {
+            if (p->origins[j].index == u) {
+                p->origins[j] = p->origins[--p->origin_count];
+                break;
+            }
+        }
+        spf_prefix_mark(spf, v->prefixes[i].index);
+    }
+    status_t status = STATUS_SUCCESS;
+    for (uint32_t i = 0; i < count; i++) {
+        spf_prefix_t *p = &spf->prefixes[refs[i].index];
+        if (!spf_grow((void **)&p->origins, &p->origin_cap, p->origin_count + 1, sizeof(spf_ref_t))) {
+            status = STATUS_NO_MEMORY;      // The prefix stays withdrawn from this vertex
+            continue;
+        }
+        p->origins[p->origin_count].index = u;
+        p->origins[p->origin_count].metric = refs[i].metric;
+        p->origin_count++;
+        spf_prefix_mark(spf, refs[i].index);
+    }
+
+    free(v->prefixes);
+    v->prefixes = refs;
+    v->prefix_count = count;
+    return status;
+}
+
+/**
+ * @brief Remove a vertex, as when its LSA is flushed
+ *
+ * @param spf Engine
+ * @param type Vertex type
+ * @param id Vertex ID
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if the vertex is unknown
+ */
+status_t ospf_spf_remove_vertex(ospf_spf_t *spf, ospf_spf_vertex_type_t type, uint32_t id) {
+    if (!spf) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (spf_index_find(&spf->vertex_index, SPF_VERTEX_KEY(type, id), spf->vertices,
+                       sizeof(spf_vertex_t)) == SPF_NOT_QUEUED) {
+        return STATUS_NOT_FOUND;
+    }
+
+    /* The slot stays; other vertices' links may still name it */
+    status_t status = ospf_spf_set_links(spf, type, id, NULL, 0);
+    if (status == STATUS_SUCCESS) {
+        status = ospf_spf_set_prefixes(spf, type, id, NULL, 0);
+    }
+    return status;
+}
+
+/**
+ * @brief Bring the routes up to date with the topology
+ *
+ * @param spf Engine
+ * @param cb Called for each route that changed, may be NULL
+ * @param ctx Passed to cb
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t ospf_spf_run(ospf_spf_t *spf, ospf_spf_route_cb_t cb, void *ctx) {
+    if (!spf) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    uint64_t start = spf_now_us();
+
+    /* Before the tree, whose staleness also invalidates the alternates */
+    if (spf->tree_stale || spf->lfa_stale) {
+        bool changed = false;
+
+        // Out of memory leaves the routes unprotected until the next run
+        spf->lfa_stale = spf_lfa_update(spf, &changed) != STATUS_SUCCESS;
+        spf->stats.lfa_runs++;
+        for (uint32_t i = 0; changed && i < spf->prefix_count; i++) {
+            spf_prefix_mark(spf, i);
+        }
+    }
+
+    if (spf->tree_stale) {
+        spf_dijkstra(spf);
+        spf->tree_stale = false;
+        for (uint32_t i = 0; i < spf->prefix_count; i++) {
+            spf_prefix_mark(spf, i);
+        }
+        spf->stats.full_runs++;
+    } else {
+        spf->stats.partial_runs++;
+    }
+
+    for (uint32_t i = 0; i < spf->dirty_count; i++) {
+        spf_prefix_t *p = &spf->prefixes[spf->dirty[i]];
+        ospf_spf_route_t route;
+
+        p->dirty = false;
+        if (spf_route_compute(spf, p, &route)) {
+            spf->stats.protected_prefixes += (route.backup != 0) - (p->route.backup != 0);
+            p->route = route;
+            spf->stats.routes_changed++;
+            if (cb) {
+                cb(&p->route, ctx);
+            }
+        }
+    }
+    spf->dirty_count = 0;
+
+    spf->stats.last_run_us = spf_now_us() - start;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the distance of a vertex from the root after the last run
+ *
+ * @param spf Engine
+ * @param type Vertex type
+ * @param id Vertex ID
+ * @return Distance, OSPF_SPF_INFINITY if unknown or unreachable
+ */
+uint32_t ospf_spf_get_distance(const ospf_spf_t *spf, ospf_spf_vertex_type_t type, uint32_t id) {
+    if (!spf) {
+        return OSPF_SPF_INFINITY;
+    }
+
+    uint32_t u = spf_index_find(&spf->vertex_index, SPF_VERTEX_KEY(type, id), spf->vertices,
+                                sizeof(spf_vertex_t));
+    return u == SPF_NOT_QUEUED ? OSPF_SPF_INFINITY : spf->vertices[u].dist;
+}
+
+/**
+ * @brief Get the current route to a prefix
+ *
+ * @param spf Engine
+ * @param addr Network address, host order
+ * @param prefix_len Prefix length
+ * @param[out] route Route
+ * @return STATUS_SUCCESS on success, STATUS_NOT_FOUND if the prefix is unreachable
+ */
+status_t ospf_spf_get_route(const ospf_spf_t *spf, uint32_t addr, uint8_t prefix_len,
+                            ospf_spf_route_t *route) {
+    if (!spf || !route || prefix_len > 32) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    uint32_t p = spf_index_find(&spf->prefix_index, SPF_PREFIX_KEY(addr, prefix_len), spf->prefixes,
+                                sizeof(spf_prefix_t));
+    if (p == SPF_NOT_QUEUED || spf->prefixes[p].route.cost == OSPF_SPF_INFINITY) {
+        return STATUS_NOT_FOUND;
+    }
+
+    *route = spf->prefixes[p].route;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get engine counters
+ *
+ * @param spf Engine
+ * @param[out] stats Counters
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t ospf_spf_get_stats(const ospf_spf_t *spf, ospf_spf_stats_t *stats) {
+    if (!spf || !stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    *stats = spf->stats;
+    stats->vertices = spf->vertex_count;
+    stats->prefixes = spf->prefix_count;
+    return STATUS_SUCCESS;
+}
+
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/**
+ * @brief Mix a key into an index hash
+ */
+static uint32_t spf_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (uint32_t)key;
+}
+
+/**
+ * @brief Allocate an empty index
+ *
+ * @param index Index
+ * @param cap Number of slots, a power of two
+ * @return STATUS_SUCCESS on success, STATUS_NO_MEMORY
+ */
+static status_t spf_index_init(spf_index_t *index, uint32_t cap) {
+    index->slots = calloc(cap, sizeof(uint32_t));
+    if (!index->slots) {
+        return STATUS_NO_MEMORY;
+    }
+    index->mask = cap - 1;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Find the array position of a key
+ *
+ * @param index Index
+ * @param key Key
+ * @param base Array the index covers; each element starts with its key
+ * @param stride Size of an element
+ * @return Position, SPF_NOT_QUEUED if absent
+ */
+static uint32_t spf_index_find(const spf_index_t *index, uint64_t key, const void *base, size_t stride) {
+    for (uint32_t slot = spf_hash(key) & index->mask;; slot = (slot + 1) & index->mask) {
+        uint32_t pos = index->slots[slot];
+        if (pos == 0) {
+            return SPF_NOT_QUEUED;
+        }
+        if (*(const uint64_t *)((const uint8_t *)base + (size_t)(pos - 1) * stride) == key) {
+            return pos - 1;
+        }
+    }
+}
+
+/**
+ * @brief Add a key to an index, doubling it past half full
+ *
+ * @param index Index
+ * @param key Key of the new element
+ * @param pos Its array position
+ * @param base Array the index covers
+ * @param stride Size of an element
+ * @param count Elements in the array, the new one included
+ * @return STATUS_SUCCESS on success, STATUS_NO_MEMORY
+ */
+static status_t spf_index_insert(spf_index_t *index, uint64_t key, uint32_t pos,
+                                 const void *base, size_t stride, uint32_t count) {
+    if (count * 2 > index->mask + 1) {
+        spf_index_t bigger;
+        if (spf_index_init(&bigger, (index->mask + 1) * 2) != STATUS_SUCCESS) {
+            return STATUS_NO_MEMORY;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            if (i == pos) {
+                continue;
+            }
+            uint64_t k = *(const uint64_t *)((const uint8_t *)base + (size_t)i * stride);
+            uint32_t slot = spf_hash(k) & bigger.mask;
+            while (bigger.slots[slot] != 0) {
+                slot = (slot + 1) & bigger.mask;
+            }
+            bigger.slots[slot] = i + 1;
+        }
+        free(index->slots);
+        *index = bigger;
+    }
+
+    uint32_t slot = spf_hash(key) & index->mask;
+    while (index->slots[slot] != 0) {
+        slot = (slot + 1) & index->mask;
+    }
+    index->slots[slot] = pos + 1;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Make room for need elements in a growable array
+ *
+ * @return false if out of memory
+ */
+static bool spf_grow(void **array, uint32_t *cap, uint32_t need, size_t size) {
+    if (need <= *cap) {
+        return true;
+    }
+
+    uint32_t new_cap = *cap ? *cap : 4;
+    while (new_cap < need) {
+        new_cap *= 2;
+    }
+    void *grown = realloc(*array, (size_t)new_cap * size);
+    if (!grown) {
+        return false;
+    }
+    *array = grown;
+    *cap = new_cap;
+    return true;
+}
+
+/**
+ * @brief Find a vertex, creating an unreachable one without links if needed
+ *
+ * @return Vertex index, SPF_NOT_QUEUED if out of memory
+ */
+static uint32_t spf_vertex_get(ospf_spf_t *spf, uint64_t key) {
+    uint32_t u = spf_index_find(&spf->vertex_index, key, spf->vertices, sizeof(spf_vertex_t));
+    if (u != SPF_NOT_QUEUED) {
+        return u;
+    }
+
+    if (!spf_grow((void **)&spf->vertices, &spf->vertex_cap, spf->vertex_count + 1, sizeof(spf_vertex_t)) ||
+        !spf_grow((void **)&spf->heap, &spf->heap_cap, spf->vertex_count + 1, sizeof(uint32_t))) {
+        return SPF_NOT_QUEUED;
+    }
+
+    u = spf->vertex_count;
+    spf_vertex_t *v = &spf->vertices[u];
+    memset(v, 0, sizeof(*v));
+    v->key = key;
+    v->dist = OSPF_SPF_INFINITY;
+    v->heap_pos = SPF_NOT_QUEUED;
+    if (spf_index_insert(&spf->vertex_index, key, u, spf->vertices, sizeof(spf_vertex_t), u + 1) != STATUS_SUCCESS) {
+        return SPF_NOT_QUEUED;
+    }
+    spf->vertex_count++;
+    return u;
+}
+
+/**
+ * @brief Find a prefix, creating an unreachable one if needed
+ *
+ * @return Prefix index, SPF_NOT_QUEUED if out of memory
+ */
+static uint32_t spf_prefix_get(ospf_spf_t *spf, uint32_t addr, uint8_t prefix_len) {
+    uint64_t key = SPF_PREFIX_KEY(addr, prefix_len);
+    uint32_t p = spf_index_find(&spf->prefix_index, key, spf->prefixes, sizeof(spf_prefix_t));
+    if (p != SPF_NOT_QUEUED) {
+        return p;
+    }
+
+    if (!spf_grow((void **)&spf->prefixes, &spf->prefix_cap, spf->prefix_count + 1, sizeof(spf_prefix_t)) ||
+        !spf_grow((void **)&spf->dirty, &spf->dirty_cap, spf->prefix_count + 1, sizeof(uint32_t))) {
+        return SPF_NOT_QUEUED;
+    }
+
+    p = spf->prefix_count;
+    spf_prefix_t *prefix = &spf->prefixes[p];
+    memset(prefix, 0, sizeof(*prefix));
+    prefix->key = key;
+    prefix->route.addr = addr;
+    prefix->route.prefix_len = prefix_len;
+    prefix->route.cost = OSPF_SPF_INFINITY;
+    if (spf_index_insert(&spf->prefix_index, key, p, spf->prefixes, sizeof(spf_prefix_t), p + 1) != STATUS_SUCCESS) {
+        return SPF_NOT_QUEUED;
+    }
+    spf->prefix_count++;
+    return p;
+}
+
+/**
+ * @brief Queue a prefix for the next route calculation
+ */
+static void spf_prefix_mark(ospf_spf_t *spf, uint32_t prefix) {
+    if (!spf->prefixes[prefix].dirty) {
+        spf->prefixes[prefix].dirty = true;
+        spf->dirty[spf->dirty_count++] = prefix;
+    }
+}
+
+/**
+ * @brief Cost of the link from a vertex to another
+ *
+ * @return Metric, OSPF_SPF_INFINITY if there is no such link
+ */
+static uint32_t spf_edge_metric(const spf_vertex_t *from, uint32_t to) {
+    for (uint32_t i = 0; i < from->edge_count; i++) {
+        if (from->edges[i].to == to) {
+            return from->edges[i].metric;
+        }
+    }
+    return OSPF_SPF_INFINITY;
+}
+
+/**
+ * @brief Check whether a link lies on, ties or beats a shortest path
+ */
+static bool spf_edge_tight(const ospf_spf_t *spf, uint32_t from, uint32_t to, uint32_t metric) {
+    uint64_t dist = spf->vertices[from].dist;
+    if (dist == OSPF_SPF_INFINITY || metric == OSPF_SPF_INFINITY) {
+        return false;
+    }
+    return dist + metric <= spf->vertices[to].dist;
+}
+
+/**
+ * @brief Mark the tree stale if a link change can move it
+ *
+ * @param spf Engine
+ * @param from Vertex whose links change
+ * @param to Far end of the link
+ * @param metric Old or new cost of the link
+ */
+static void spf_note_link_change(ospf_spf_t *spf, uint32_t from, uint32_t to, uint32_t metric) {
+    /* A neighbor's paths may use it whether or not the root's do */
+    spf->lfa_stale = true;
+    if (spf_edge_tight(spf, from, to, metric) ||
+        spf_edge_tight(spf, to, from, spf_edge_metric(&spf->vertices[to], from))) {
+        spf->tree_stale = true;
+    }
+}
+
+/**
+ * @brief Heap order: nearer first, networks before routers at equal distance
+ *
+ * Taking networks first lets the zero-cost links to their routers merge
+ * equal-cost paths before those routers are settled.
+ */
+static bool spf_heap_less(const ospf_spf_t *spf, uint32_t a, uint32_t b) {
+    const spf_vertex_t *va = &spf->vertices[a];
+    const spf_vertex_t *vb = &spf->vertices[b];
+    if (va->dist != vb->dist) {
+        return va->dist < vb->dist;
+    }
+    return SPF_KEY_TYPE(va->key) > SPF_KEY_TYPE(vb->key);
+}
+
+/**
+ * @brief Move a heap entry towards the top
+ */
+static void spf_heap_up(ospf_spf_t *spf, uint32_t pos) {
+    uint32_t u = spf->heap[pos];
+    while (pos > 0) {
+        uint32_t parent = (pos - 1) / 2;
+        if (!spf_heap_less(spf, u, spf->heap[parent])) {
+            break;
+        }
+        spf->heap[pos] = spf->heap[parent];
+        spf->vertices[spf->heap[pos]].heap_pos = pos;
+        pos = parent;
+    }
+    spf->heap[pos] = u;
+    spf->vertices[u].heap_pos = pos;
+}
+
+/**
+ * @brief Move a heap entry towards the bottom
+ */
+static void spf_heap_down(ospf_spf_t *spf, uint32_t pos) {
+    uint32_t u = spf->heap[pos];
+    for (;;) {
+        uint32_t child = 2 * pos + 1;
+        if (child >= spf->heap_size) {
+            break;
+        }
+        if (child + 1 < spf->heap_size && spf_heap_less(spf, spf->heap[child + 1], spf->heap[child])) {
+            child++;
+        }
+        if (!spf_heap_less(spf, spf->heap[child], u)) {
+            break;
+        }
+        spf->heap[pos] = spf->heap[child];
+        spf->vertices[spf->heap[pos]].heap_pos = pos;
+        pos = child;
+    }
+    spf->heap[pos] = u;
+    spf->vertices[u].heap_pos = pos;
+}
+
+/**
+ * @brief Compute the shortest path tree from the root (RFC 2328 16.1)
+ *
+ * A vertex reached straight from the root, or through a network the root
+ * is attached to, is its own first hop; any other vertex inherits the
+ * first hops of the vertices it is reached through.
+ */
+static void spf_dijkstra(ospf_spf_t *spf) {
+    for (uint32_t i = 0; i < spf->vertex_count; i++) {
+        spf->vertices[i].dist = OSPF_SPF_INFINITY;
+        spf->vertices[i].heap_pos = SPF_NOT_QUEUED;
+        spf->vertices[i].nh_count = 0;
+    }
+
+    spf->vertices[SPF_ROOT].dist = 0;
+    spf->heap[0] = SPF_ROOT;
+    spf->vertices[SPF_ROOT].heap_pos = 0;
+    spf->heap_size = 1;
+
+    while (spf->heap_size > 0) {
+        uint32_t u = spf->heap[0];
+        spf_vertex_t *vu = &spf->vertices[u];
+        vu->heap_pos = SPF_SETTLED;
+        if (--spf->heap_size > 0) {
+            spf->heap[0] = spf->heap[spf->heap_size];
+            spf_heap_down(spf, 0);
+        }
+
+        bool direct = u == SPF_ROOT ||
+                      (SPF_KEY_TYPE(vu->key) == OSPF_SPF_VERTEX_NETWORK && vu->nh_count == 1 && vu->nh[0] == u);
+
+        for (uint32_t i = 0; i < vu->edge_count; i++) {
+            uint32_t w = vu->edges[i].to;
+            spf_vertex_t *vw = &spf->vertices[w];
+            if (vw->heap_pos == SPF_SETTLED || spf_edge_metric(vw, u) == OSPF_SPF_INFINITY) {
+                continue;
+            }
+
+            uint64_t dist = (uint64_t)vu->dist + vu->edges[i].metric;
+            if (dist >= OSPF_SPF_INFINITY) {
+                continue;
+            }
+
+            const uint32_t *nh = direct ? &w : vu->nh;
+            uint8_t nh_count = direct ? 1 : vu->nh_count;
+
+            if (dist < vw->dist) {
+                vw->dist = (uint32_t)dist;
+                memcpy(vw->nh, nh, nh_count * sizeof(uint32_t));
+                vw->nh_count = nh_count;
+                if (vw->heap_pos == SPF_NOT_QUEUED) {
+                    spf->heap[spf->heap_size] = w;
+                    vw->heap_pos = spf->heap_size++;
+                }
+                spf_heap_up(spf, vw->heap_pos);
+            } else if (dist == vw->dist) {
+                /* Equal-cost path: merge its first hops */
+                for (uint8_t j = 0; j < nh_count && vw->nh_count < OSPF_SPF_MAX_PATHS; j++) {
+                    bool known = false;
+                    for (uint8_t k = 0; k < vw->nh_count; k++) {
+                        known |= vw->nh[k] == nh[j];
+                    }
+                    if (!known) {
+                        vw->nh[vw->nh_count++] = nh[j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Compute the route to a prefix from the current tree
+ *
+ * The loop-free alternate is part of the route.
+ *
+ * @param spf Engine
+ * @param prefix Prefix
+ * @param[out] route New route
+ * @return true if it differs from the route reported last
+ */
+static bool spf_route_compute(const ospf_spf_t *spf, const spf_prefix_t *prefix, ospf_spf_route_t *route) {
+    memset(route, 0, sizeof(*route));
+    route->addr = prefix->route.addr;
+    route->prefix_len = prefix->route.prefix_len;
+    route->cost = OSPF_SPF_INFINITY;
+
+    for (uint32_t i = 0; i < prefix->origin_count; i++) {
+        const spf_vertex_t *v = &spf->vertices[prefix->origins[i].index];
+        uint64_t cost = (uint64_t)v->dist + prefix->origins[i].metric;
+        if (v->dist == OSPF_SPF_INFINITY || cost >= OSPF_SPF_INFINITY || cost > route->cost) {
+            continue;
+        }
+        if (cost < route->cost) {
+            route->cost = (uint32_t)cost;
+            route->nexthop_count = 0;
+        }
+
+        /* The root's own prefixes are directly attached */
+        uint32_t own = 0;
+        const uint32_t *nh = prefix->origins[i].index == SPF_ROOT ? &own : v->nh;
+        uint8_t nh_count = prefix->origins[i].index == SPF_ROOT ? 1 : v->nh_count;
+        for (uint8_t j = 0; j < nh_count && route->nexthop_count < OSPF_SPF_MAX_PATHS; j++) {
+            uint32_t router = 0;
+            if (nh != &own && SPF_KEY_TYPE(spf->vertices[nh[j]].key) == OSPF_SPF_VERTEX_ROUTER) {
+                router = SPF_KEY_ID(spf->vertices[nh[j]].key);
+            }
+            bool known = false;
+            for (uint8_t k = 0; k < route->nexthop_count; k++) {
+                known |= route->nexthops[k] == router;
+            }
+            if (!known) {
+                route->nexthops[route->nexthop_count++] = router;
+            }
+        }
+    }
+
+    spf_lfa_compute(spf, prefix, route);
+
+    /* Next hops are compared as sets */
+    const ospf_spf_route_t *old = &prefix->route;
+    if (route->cost != old->cost || route->nexthop_count != old->nexthop_count ||
+        route->backup != old->backup) {
+        return true;
+    }
+    for (uint8_t i = 0; i < route->nexthop_count; i++) {
+        bool found = false;
+        for (uint8_t j = 0; j < old->nexthop_count; j++) {
+            found |= route->nexthops[i] == old->nexthops[j];
+        }
+        if (!found) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Move an entry of a neighbor's heap towards the top
+ */
+static void spf_dist_up(uint32_t *heap, uint32_t *pos, const uint32_t *dist, uint32_t at) {
+    uint32_t u = heap[at];
+    while (at > 0) {
+        uint32_t parent = (at - 1) / 2;
+        if (dist[heap[parent]] <= dist[u]) {
+            break;
+        }
+        heap[at] = heap[parent];
+        pos[heap[at]] = at;
+        at = parent;
+    }
+    heap[at] = u;
+    pos[u] = at;
+}
+
+/**
+ * @brief Move an entry of a neighbor's heap towards the bottom
+ */
+static void spf_dist_down(uint32_t *heap, uint32_t *pos, const uint32_t *dist, uint32_t size, uint32_t at) {
+    uint32_t u = heap[at];
+    for (;;) {
+        uint32_t child = 2 * at + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size && dist[heap[child + 1]] < dist[heap[child]]) {
+            child++;
+        }
+        if (dist[u] <= dist[heap[child]]) {
+            break;
+        }
+        heap[at] = heap[child];
+        pos[heap[at]] = at;
+        at = child;
+    }
+    heap[at] = u;
+    pos[u] = at;
+}
+
+/**
+ * @brief Shortest distances from any vertex, without first hops
+ *
+ * Links count under the same two-way check as in the tree.
+ *
+ * @param spf Engine, whose scratch arrays hold vertex_count entries
+ * @param source Vertex index
+ * @param[out] dist Distance of every vertex, OSPF_SPF_INFINITY if unreachable
+ */
+static void spf_distances(ospf_spf_t *spf, uint32_t source, uint32_t *dist) {
+    uint32_t *heap = spf->lfa_heap;
+    uint32_t *pos = spf->lfa_pos;
+    uint32_t size = 1;
+
+    for (uint32_t i = 0; i < spf->vertex_count; i++) {
+        dist[i] = OSPF_SPF_INFINITY;
+        pos[i] = SPF_NOT_QUEUED;
+    }
+    dist[source] = 0;
+    heap[0] = source;
+    pos[source] = 0;
+
+    while (size > 0) {
+        uint32_t u = heap[0];
+        const spf_vertex_t *vu = &spf->vertices[u];
+        pos[u] = SPF_SETTLED;
+        if (--size > 0) {
+            heap[0] = heap[size];
+            spf_dist_down(heap, pos, dist, size, 0);
+        }
+
+        for (uint32_t i = 0; i < vu->edge_count; i++) {
+            uint32_t w = vu->edges[i].to;
+            if (pos[w] == SPF_SETTLED || spf_edge_metric(&spf->vertices[w], u) == OSPF_SPF_INFINITY) {
+                continue;
+            }
+            uint64_t d = (uint64_t)dist[u] + vu->edges[i].metric;
+            if (d >= OSPF_SPF_INFINITY || d >= dist[w]) {
+                continue;
+            }
+            dist[w] = (uint32_t)d;
+            if (pos[w] == SPF_NOT_QUEUED) {
+                heap[size] = w;
+                pos[w] = size++;
+            }
+            spf_dist_up(heap, pos, dist, pos[w]);
+        }
+    }
+}
+
+/**
+ * @brief Recompute the neighbors of the root and their distances
+ *
+ * A neighbor is a router linked to the root, straight or across a transit
+ * network the root is attached to, with the links checked both ways.
+ *
+ * @param spf Engine
+ * @param[out] changed Whether the neighbors or any of their distances differ
+ * @return STATUS_SUCCESS on success, STATUS_NO_MEMORY with no neighbors left
+ */
+static status_t spf_lfa_update(ospf_spf_t *spf, bool *changed) {
+    const spf_vertex_t *root = &spf->vertices[SPF_ROOT];
+    uint32_t n = spf->vertex_count;
+    uint32_t *nbrs = NULL;
+    uint32_t *dist = NULL;
+    uint32_t count = 0;
+    uint32_t cap = 0;
+
+    for (uint32_t i = 0; i < root->edge_count; i++) {
+        uint32_t w = root->edges[i].to;
+        const spf_vertex_t *vw = &spf->vertices[w];
+        if (spf_edge_metric(vw, SPF_ROOT) == OSPF_SPF_INFINITY) {
+            continue;
+        }
+
+        /* The network itself, or the routers on it */
+        bool network = SPF_KEY_TYPE(vw->key) == OSPF_SPF_VERTEX_NETWORK;
+        for (uint32_t j = 0; j < (network ? vw->edge_count : 1); j++) {
+            uint32_t r = network ? vw->edges[j].to : w;
+            if (r == SPF_ROOT || SPF_KEY_TYPE(spf->vertices[r].key) != OSPF_SPF_VERTEX_ROUTER ||
+                (network && spf_edge_metric(&spf->vertices[r], w) == OSPF_SPF_INFINITY)) {
+                continue;
+            }
+            bool known = false;
+            for (uint32_t k = 0; k < count; k++) {
+                known |= nbrs[k] == r;
+            }
+            if (known) {
+                continue;
+            }
+            if (!spf_grow((void **)&nbrs, &cap, count + 1, sizeof(uint32_t))) {
+                goto no_memory;
+            }
+            nbrs[count++] = r;
+        }
+    }
+
+    if (count > 0) {
+        uint32_t scratch = spf->lfa_scratch_cap;
+        dist = malloc((size_t)count * n * sizeof(uint32_t));
+        if (!dist || !spf_grow((void **)&spf->lfa_heap, &scratch, n, sizeof(uint32_t)) ||
+            !spf_grow((void **)&spf->lfa_pos, &spf->lfa_scratch_cap, n, sizeof(uint32_t))) {
+            goto no_memory;
+        }
+        for (uint32_t k = 0; k < count; k++) {
+            spf_distances(spf, nbrs[k], dist + (size_t)k * n);
+        }
+    }
+
+    *changed = count != spf->lfa_count || (count > 0 && n != spf->lfa_vertices) ||
+               (count > 0 && (memcmp(nbrs, spf->lfa_nbrs, count * sizeof(uint32_t)) != 0 ||
+                              memcmp(dist, spf->lfa_dist, (size_t)count * n * sizeof(uint32_t)) != 0));
+    free(spf->lfa_nbrs);
+    free(spf->lfa_dist);
+    spf->lfa_nbrs = nbrs;
+    spf->lfa_dist = dist;
+    spf->lfa_count = count;
+    spf->lfa_vertices = n;
+    return STATUS_SUCCESS;
+
+no_memory:
+    free(nbrs);
+    free(dist);
+    *changed = spf->lfa_count > 0;
+    free(spf->lfa_nbrs);
+    free(spf->lfa_dist);
+    spf->lfa_nbrs = NULL;
+    spf->lfa_dist = NULL;
+    spf->lfa_count = 0;
+    return STATUS_NO_MEMORY;
+}
+
+/**
+ * @brief Pick the loop-free alternate of a route (RFC 5286 3.5)
+ *
+ * A neighbor N that is not a primary next hop qualifies when
+ * dist(N, D) < dist(N, root) + dist(root, D), so that its own shortest
+ * path to the prefix D does not lead back here; the nearest one to D is
+ * taken. Directly attached prefixes have none.
+ *
+ * @param spf Engine
+ * @param prefix Prefix
+ * @param[in,out] route Route with its primary next hops, given its backup
+ */
+static void spf_lfa_compute(const ospf_spf_t *spf, const spf_prefix_t *prefix, ospf_spf_route_t *route) {
+    uint64_t best = OSPF_SPF_INFINITY;
+
+    route->backup = 0;
+    if (route->cost == OSPF_SPF_INFINITY) {
+        return;
+    }
+    for (uint8_t i = 0; i < route->nexthop_count; i++) {
+        if (route->nexthops[i] == 0) {
+            return;
+        }
+    }
+
+    for (uint32_t k = 0; k < spf->lfa_count; k++) {
+        uint32_t id = SPF_KEY_ID(spf->vertices[spf->lfa_nbrs[k]].key);
+        const uint32_t *dist = spf->lfa_dist + (size_t)k * spf->lfa_vertices;
+        bool primary = false;
+        for (uint8_t i = 0; i < route->nexthop_count; i++) {
+            primary |= route->nexthops[i] == id;
+        }
+        if (primary || dist[SPF_ROOT] == OSPF_SPF_INFINITY) {
+            continue;
+        }
+
+        uint64_t via = OSPF_SPF_INFINITY;
+        for (uint32_t i = 0; i < prefix->origin_count; i++) {
+            uint32_t o = prefix->origins[i].index;
+            if (o < spf->lfa_vertices && dist[o] != OSPF_SPF_INFINITY &&
+                (uint64_t)dist[o] + prefix->origins[i].metric < via) {
+                via = (uint64_t)dist[o] + prefix->origins[i].metric;
+            }
+        }
+        if (via < (uint64_t)dist[SPF_ROOT] + route->cost && via < best) {
+            best = via;
+            route->backup = id;
+        }
+    }
+}
+
+/**
+ * @brief Current monotonic time in microseconds
+ */
+static uint64_t spf_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
@@ -0,0 +1,252 @@
+/**
+ * @file ospf_throttle.c
+ * @brief Implementation of OSPF SPF back-off and LSA throttling
+ *
+ * The SPF scheduler is the state machine of RFC 8405 section 6 with its
+ * three timers (SPF_TIMER, LEARN_TIMER, HOLDDOWN_TIMER) on the event
+ * loop's timer wheel. The LSA throttle needs a single timer per LSA: the
+ * hold interval doubles on every origination and is reset once the LSA
+ * has gone unchanged for twice the maximum wait.
+ */
+
+#include "l3/ospf_throttle.h"
+#include <string.h>
+
+/* Defines */
+#define THROTTLE_USEC_PER_MSEC  1000ULL
+
+/* Forward declarations of private functions */
+static void spf_backoff_spf_timer_cb(event_timer_t *timer, void *arg);
+static void spf_backoff_learn_timer_cb(event_timer_t *timer, void *arg);
+static void spf_backoff_holddown_timer_cb(event_timer_t *timer, void *arg);
+static void lsa_throttle_timer_cb(event_timer_t *timer, void *arg);
+static void throttle_timer_start(event_timer_t *timer, uint32_t delay_ms);
+
+/**
+ * @brief Get the default timing
+ *
+ * @param[out] config Timing
+ */
+void ospf_throttle_get_default_config(ospf_throttle_config_t *config) {
+    if (!config) {
+        return;
+    }
+
+    memset(config, 0, sizeof(*config));
+    config->spf_initial_delay_ms = OSPF_THROTTLE_SPF_INITIAL_DELAY_MS;
+    config->spf_short_delay_ms = OSPF_THROTTLE_SPF_SHORT_DELAY_MS;
+    config->spf_long_delay_ms = OSPF_THROTTLE_SPF_LONG_DELAY_MS;
+    config->spf_time_to_learn_ms = OSPF_THROTTLE_SPF_TIME_TO_LEARN_MS;
+    config->spf_holddown_ms = OSPF_THROTTLE_SPF_HOLDDOWN_MS;
+    config->lsa_start_ms = OSPF_THROTTLE_LSA_START_MS;
+    config->lsa_hold_ms = OSPF_THROTTLE_LSA_HOLD_MS;
+    config->lsa_max_wait_ms = OSPF_THROTTLE_LSA_MAX_WAIT_MS;
+}
+
+/**
+ * @brief Check a timing for consistency
+ *
+ * @param config Timing
+ * @return STATUS_SUCCESS if usable, STATUS_INVALID_PARAMETER otherwise
+ */
+status_t ospf_throttle_validate_config(const ospf_throttle_config_t *config) {
+    if (!config) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (config->spf_short_delay_ms > config->spf_long_delay_ms ||
+        config->spf_time_to_learn_ms >= config->spf_holddown_ms ||
+        config->lsa_hold_ms > config->lsa_max_wait_ms) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Prepare the SPF scheduler of an area
+ *
+ * @param backoff Scheduler
+ * @param config Timing, referenced rather than copied so a change applies at once
+ * @param run_spf Runs SPF for the area
+ * @param arg Passed to run_spf
+ */
+void ospf_spf_backoff_init(ospf_spf_backoff_t *backoff, const ospf_throttle_config_t *config,
+                           ospf_throttle_cb_t run_spf, void *arg) {
+    memset(backoff, 0, sizeof(*backoff));
+    backoff->config = config;
+    backoff->state = OSPF_SPF_BACKOFF_QUIET;
+    backoff->run_spf = run_spf;
+    backoff->arg = arg;
+    event_timer_init(&backoff->spf_timer, spf_backoff_spf_timer_cb, backoff);
+    event_timer_init(&backoff->learn_timer, spf_backoff_learn_timer_cb, backoff);
+    event_timer_init(&backoff->holddown_timer, spf_backoff_holddown_timer_cb, backoff);
+}
+
+/**
+ * @brief Report an IGP event that requires an SPF run
+ *
+ * An SPF run already scheduled absorbs the event; only HOLDDOWN moves.
+ *
+ * @param backoff Scheduler
+ */
+void ospf_spf_backoff_event(ospf_spf_backoff_t *backoff) {
+    const ospf_throttle_config_t *config = backoff->config;
+
+    backoff->events++;
+
+    switch (backoff->state) {
+        case OSPF_SPF_BACKOFF_QUIET:
+            throttle_timer_start(&backoff->spf_timer, config->spf_initial_delay_ms);
+            throttle_timer_start(&backoff->learn_timer, config->spf_time_to_learn_ms);
+            throttle_timer_start(&backoff->holddown_timer, config->spf_holddown_ms);
+            backoff->state = OSPF_SPF_BACKOFF_SHORT_WAIT;
+            break;
+
+        case OSPF_SPF_BACKOFF_SHORT_WAIT:
+            throttle_timer_start(&backoff->holddown_timer, config->spf_holddown_ms);
+            if (!event_timer_pending(&backoff->spf_timer)) {
+                throttle_timer_start(&backoff->spf_timer, config->spf_short_delay_ms);
+            }
+            break;
+
+        case OSPF_SPF_BACKOFF_LONG_WAIT:
+            throttle_timer_start(&backoff->holddown_timer, config->spf_holddown_ms);
+            if (!event_timer_pending(&backoff->spf_timer)) {
+                throttle_timer_start(&backoff->spf_timer, config->spf_long_delay_ms);
+            }
+            break;
+    }
+}
+
+/**
+ * @brief Stop the scheduler and return it to QUIET
+ *
+ * @param backoff Scheduler
+ */
+void ospf_spf_backoff_reset(ospf_spf_backoff_t *backoff) {
+    (void)event_timer_stop(&backoff->spf_timer);
+    (void)event_timer_stop(&backoff->learn_timer);
+    (void)event_timer_stop(&backoff->holddown_timer);
+    backoff->state = OSPF_SPF_BACKOFF_QUIET;
+}
+
+/**
+ * @brief Get the back-off state
+ *
+ * @param backoff Scheduler
+ * @return Current state
+ */
+ospf_spf_backoff_state_t ospf_spf_backoff_get_state(const ospf_spf_backoff_t *backoff) {
+    return backoff->state;
+}
+
+/**
+ * @brief Prepare the origination throttle of an LSA
+ *
+ * @param throttle Throttle
+ * @param config Timing, referenced rather than copied
+ * @param originate Builds and floods a new instance of the LSA
+ * @param arg Passed to originate
+ */
+void ospf_lsa_throttle_init(ospf_lsa_throttle_t *throttle, const ospf_throttle_config_t *config,
+                            ospf_throttle_cb_t originate, void *arg) {
+    memset(throttle, 0, sizeof(*throttle));
+    throttle->config = config;
+    throttle->originate = originate;
+    throttle->arg = arg;
+    event_timer_init(&throttle->timer, lsa_throttle_timer_cb, throttle);
+}
+
+/**
+ * @brief Ask for a new instance of the LSA
+ *
+ * @param throttle Throttle
+ * @return true if an origination was scheduled, false if one was pending already
+ */
+bool ospf_lsa_throttle_request(ospf_lsa_throttle_t *throttle) {
+    const ospf_throttle_config_t *config = throttle->config;
+
+    if (event_timer_pending(&throttle->timer)) {
+        return false;
+    }
+
+    uint64_t now = event_loop_now_us();
+    uint64_t quiet_us = 2 * (uint64_t)config->lsa_max_wait_ms * THROTTLE_USEC_PER_MSEC;
+
+    if (throttle->last_us == 0 || now - throttle->last_us >= quiet_us) {
+        /* Quiet long enough: start over from the start delay */
+        throttle->interval_ms = 0;
+        throttle_timer_start(&throttle->timer, config->lsa_start_ms);
+        return true;
+    }
+
+    uint64_t due = throttle->last_us + (uint64_t)throttle->interval_ms * THROTTLE_USEC_PER_MSEC;
+    uint64_t wait_us = due > now ? due - now : 0;
+    (void)event_timer_start(&throttle->timer, wait_us, 0);
+    return true;
+}
+
+/**
+ * @brief Drop a pending origination
+ *
+ * @param throttle Throttle
+ * @return true if an origination was pending
+ */
+bool ospf_lsa_throttle_cancel(ospf_lsa_throttle_t *throttle) {
+    return event_timer_stop(&throttle->timer);
+}
+
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static void spf_backoff_spf_timer_cb(event_timer_t *timer, void *arg) {
+    ospf_spf_backoff_t *backoff = (ospf_spf_backoff_t *)arg;
+    (void)timer;
+
+    backoff->runs++;
+    if (backoff->run_spf) {
+        backoff->run_spf(backoff->arg);
+    }
+}
+
+static void spf_backoff_learn_timer_cb(event_timer_t *timer, void *arg) {
+    ospf_spf_backoff_t *backoff = (ospf_spf_backoff_t *)arg;
+    (void)timer;
+
+    if (backoff->state == OSPF_SPF_BACKOFF_SHORT_WAIT) {
+        backoff->state = OSPF_SPF_BACKOFF_LONG_WAIT;
+    }
+}
+
+static void spf_backoff_holddown_timer_cb(event_timer_t *timer, void *arg) {
+    ospf_spf_backoff_t *backoff = (ospf_spf_backoff_t *)arg;
+    (void)timer;
+
+    (void)event_timer_stop(&backoff->learn_timer);
+    backoff->state = OSPF_SPF_BACKOFF_QUIET;
+}
+
+static void lsa_throttle_timer_cb(event_timer_t *timer, void *arg) {
+    ospf_lsa_throttle_t *throttle = (ospf_lsa_throttle_t *)arg;
+    const ospf_throttle_config_t *config = throttle->config;
+    (void)timer;
+
+    throttle->last_us = event_loop_now_us();
+    if (throttle->interval_ms == 0) {
+        throttle->interval_ms = config->lsa_hold_ms;
+    } else {
+        throttle->interval_ms = throttle->interval_ms * 2 < config->lsa_max_wait_ms ?
+                                throttle->interval_ms * 2 : config->lsa_max_wait_ms;
+    }
+
+    if (throttle->originate) {
+        throttle->originate(throttle->arg);
+    }
+}
+
+/**
+ * @brief Arm a one-shot timer; without a running event loop it stays idle
+ */
+static void throttle_timer_start(event_timer_t *timer, uint32_t delay_ms) {
+    (void)event_timer_start(timer, (uint64_t)delay_ms * THROTTLE_USEC_PER_MSEC, 0);
+}
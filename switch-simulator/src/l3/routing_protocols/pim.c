@@ -0,0 +1,1264 @@
+/**
+ * @file pim.c
+ * @brief Implementation of the PIM-SM router
+ *
+ * Routes live in one array of pointers sorted by (group, source), so the
+ * (*,G) route of a group, with source 0, comes right before its (S,G)
+ * routes and a change to it reaches them with a short forward walk.
+ * Downstream join state is a bitmap over the interfaces plus one expiry
+ * time per interface; each route also keeps its earliest expiry, which is
+ * all a timer pass looks at for a route with nothing due.
+ *
+ * What a route has in the FIB is remembered as a bitmap of interfaces,
+ * and every change is programmed as the difference against it. Periodic
+ * joins are gathered by upstream neighbor and group, sorted, and packed
+ * into Join/Prune messages of up to PIM_MAX_MESSAGE_LEN bytes.
+ */
+
+#include "l3/pim.h"
+#include "l3/mcast_fib.h"
+#include "hal/packet_offload.h"
+#include "common/logging.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Defines */
+#define PIM_VERSION             2
+#define PIM_HEADER_LEN          4
+#define PIM_ENC_UNICAST_LEN     6
+#define PIM_ENC_GROUP_LEN       8
+#define PIM_ENC_SOURCE_LEN      8
+#define PIM_JP_HEADER_LEN       (PIM_HEADER_LEN + PIM_ENC_UNICAST_LEN + 4)
+#define PIM_JP_GROUP_LEN        (PIM_ENC_GROUP_LEN + 4)
+#define PIM_JP_MAX_GROUPS       255
+#define PIM_ADDR_FAMILY_IPV4    1
+#define PIM_ENCODING_NATIVE     0
+
+/* Encoded-Source flags */
+#define PIM_SRC_SPARSE          0x04
+#define PIM_SRC_WILDCARD        0x02
+#define PIM_SRC_RPT             0x01
+
+/* Hello options (RFC 7761 4.9.2) */
+#define PIM_OPT_HOLDTIME        1
+#define PIM_OPT_DR_PRIORITY     19
+#define PIM_OPT_GENERATION_ID   20
+
+#define PIM_HOLDTIME_INFINITE   0xFFFF
+#define PIM_HOLDTIME_FACTOR_X2  7               /* Holdtime is 3.5 periods */
+#define PIM_DEFAULT_HOLDTIME_S  105
+#define PIM_JP_OVERRIDE_MS      3000
+#define PIM_MS_PER_S            1000ULL
+#define PIM_NEVER               UINT64_MAX
+#define PIM_INITIAL_ROUTES      64
+
+#define PIM_BIT(i)              (1ULL << (i))
+
+/* Private data types */
+
+/* Neighbor heard on an interface */
+typedef struct {
+    bool used;
+    bool has_dr_priority;
+    uint32_t address;
+    uint32_t dr_priority;
+    uint32_t generation_id;
+    uint64_t expires_ms;
+} pim_neighbor_t;
+
+/* PIM interface */
+typedef struct {
+    bool used;
+    bool is_dr;
+    pim_interface_config_t config;
+    uint32_t dr_address;
+    uint32_t neighbor_count;
+    pim_neighbor_t neighbors[PIM_MAX_NEIGHBORS];
+    uint64_t next_hello_ms;
+} pim_if_t;
+
+/* Group range mapped to an RP */
+typedef struct {
+    bool used;
+    uint32_t prefix;
+    uint8_t prefix_len;
+    uint32_t rp;
+} pim_rp_t;
+
+/* (*,G) or (S,G) route */
+typedef struct {
+    uint32_t source;                /* 0 for (*,G) */
+    uint32_t group;
+    uint32_t rp;
+    uint32_t upstream_if;
+    uint32_t upstream_nbr;          /* 0 if there is no router to join */
+    bool rpf_ok;                    /* Upstream resolved, or we are the root */
+    bool upstream_joined;           /* Joined to upstream_nbr, a prune is owed on removal */
+    bool programmed;                /* In the FIB */
+    uint64_t joined;
+    uint64_t local;
+    uint64_t fib_oifs;
+    uint64_t next_expiry_ms;        /* Earliest of expires_ms over joined */
+    uint64_t expires_ms[PIM_MAX_INTERFACES];
+} pim_route_t;
+
+/* Join/Prune message under construction */
+typedef struct {
+    uint32_t ifindex;
+    uint32_t neighbor;
+    uint16_t len;
+    uint16_t groups;
+    uint16_t group_off;             /* Current group record, 0 if none */
+    uint32_t group;
+    uint16_t joined;
+    uint16_t pruned;
+    uint8_t buf[PIM_MAX_MESSAGE_LEN];
+} pim_jp_t;
+
+/* Router */
+struct pim_router {
+    pim_config_t config;
+    pim_if_t ifs[PIM_MAX_INTERFACES];
+    pim_rp_t rps[PIM_MAX_RPS];
+    pim_route_t **routes;
+    uint32_t route_count;
+    uint32_t route_cap;
+    uint32_t generation_id;
+    uint64_t next_join_ms;
+    pim_jp_t jp;
+    pim_stats_t stats;
+};
+
+/* Forward declarations of private functions */
+static bool pim_route_find(const pim_router_t *router, uint32_t source, uint32_t group, uint32_t *pos);
+static pim_route_t *pim_route_get_or_create(pim_router_t *router, uint32_t source, uint32_t group, uint32_t rp);
+static void pim_route_resolve(pim_router_t *router, pim_route_t *route);
+static void pim_route_update(pim_router_t *router, uint32_t pos);
+static void pim_route_program(pim_router_t *router, pim_route_t *route);
+static uint64_t pim_route_own(const pim_router_t *router, const pim_route_t *route);
+static void pim_refresh_all(pim_router_t *router);
+static uint32_t pim_rp_lookup(const pim_router_t *router, uint32_t group);
+static bool pim_elect_dr(pim_if_t *itf);
+static void pim_send_hello(pim_router_t *router, uint32_t ifindex, uint16_t holdtime);
+static void pim_jp_begin(pim_router_t *router, uint32_t ifindex, uint32_t neighbor);
+static void pim_jp_add(pim_router_t *router, const pim_route_t *route, bool join);
+static void pim_jp_flush(pim_router_t *router);
+static void pim_send_join_prune(pim_router_t *router, const pim_route_t *route, bool join);
+static void pim_periodic_joins(pim_router_t *router);
+static status_t pim_input_hello(pim_router_t *router, uint32_t ifindex, uint32_t src, const uint8_t *msg,
+                                uint16_t length, uint64_t now_ms);
+static status_t pim_input_join_prune(pim_router_t *router, uint32_t ifindex, const uint8_t *msg,
+                                     uint16_t length, uint64_t now_ms);
+
+static inline uint16_t pim_read16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t pim_read32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void pim_write16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static inline void pim_write32(uint8_t *p, uint32_t v) {
+    pim_write16(p, (uint16_t)(v >> 16));
+    pim_write16(p + 2, (uint16_t)v);
+}
+
+static inline bool pim_is_multicast(uint32_t addr) {
+    return (addr & 0xF0000000u) == 0xE0000000u;
+}
+
+static inline uint64_t pim_used_mask(const pim_router_t *router) {
+    uint64_t mask = 0;
+    for (uint32_t i = 0; i < PIM_MAX_INTERFACES; i++) {
+        if (router->ifs[i].used) {
+            mask |= PIM_BIT(i);
+        }
+    }
+    return mask;
+}
+
+static uint16_t pim_holdtime_s(uint32_t period_ms) {
+    uint64_t s = (uint64_t)period_ms * PIM_HOLDTIME_FACTOR_X2 / 2 / PIM_MS_PER_S;
+    return s >= PIM_HOLDTIME_INFINITE ? PIM_HOLDTIME_INFINITE - 1 : (uint16_t)(s ? s : 1);
+}
+
+/**
+ * @brief Create a router
+ *
+ * @param config Parameters
+ * @return New router, or NULL
+ */
+pim_router_t *pim_router_create(const pim_config_t *config) {
+    if (!config || !config->send || !config->rpf) {
+        return NULL;
+    }
+
+    pim_router_t *router = (pim_router_t *)calloc(1, sizeof(pim_router_t));
+    if (!router) {
+        LOG_ERROR(LOG_CATEGORY_L3, "PIM: Failed to allocate router");
+        return NULL;
+    }
+    router->config = *config;
+    if (router->config.hello_period_ms == 0) {
+        router->config.hello_period_ms = PIM_DEFAULT_HELLO_PERIOD_MS;
+    }
+    if (router->config.join_prune_period_ms == 0) {
+        router->config.join_prune_period_ms = PIM_DEFAULT_JOIN_PRUNE_PERIOD_MS;
+    }
+    // A new generation ID tells neighbors we lost our state
+    router->generation_id = (uint32_t)time(NULL) ^ (uint32_t)(uintptr_t)router;
+    return router;
+}
+
+/**
+ * @brief Free a router and its FIB routes
+ *
+ * @param router Router
+ */
+void pim_router_destroy(pim_router_t *router) {
+    if (!router) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < router->route_count; i++) {
+        pim_route_t *route = router->routes[i];
+        if (route->programmed) {
+            mfib_route_delete(route->source, route->group);
+        }
+        free(route);
+    }
+    free(router->routes);
+    free(router);
+}
+
+/**
+ * @brief Enable PIM on an interface
+ *
+ * @param router Router
+ * @param config Interface parameters
+ * @param ifindex Interface index
+ * @return status_t Status code
+ */
+status_t pim_interface_add(pim_router_t *router, const pim_interface_config_t *config, uint32_t *ifindex) {
+    if (!router || !config || !ifindex || config->address == 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    for (uint32_t i = 0; i < PIM_MAX_INTERFACES; i++) {
+        pim_if_t *itf = &router->ifs[i];
+        if (itf->used) {
+            continue;
+        }
+        memset(itf, 0, sizeof(*itf));
+        itf->used = true;
+        itf->config = *config;
+        if (itf->config.dr_priority == 0) {
+            itf->config.dr_priority = PIM_DEFAULT_DR_PRIORITY;
+        }
+        // Alone on the link until Hellos say otherwise
+        itf->is_dr = true;
+        itf->dr_address = config->address;
+        itf->next_hello_ms = 0;
+        *ifindex = i;
+        return STATUS_SUCCESS;
+    }
+    return STATUS_RESOURCE_EXHAUSTED;
+}
+
+/**
+ * @brief Disable PIM on an interface
+ *
+ * @param router Router
+ * @param ifindex Interface
+ * @return status_t Status code
+ */
+status_t pim_interface_remove(pim_router_t *router, uint32_t ifindex) {
+    if (!router || ifindex >= PIM_MAX_INTERFACES || !router->ifs[ifindex].used) {
+        return STATUS_NOT_FOUND;
+    }
+
+    // Neighbors learn from the zero holdtime that we are gone
+    pim_send_hello(router, ifindex, 0);
+
+    // The configuration stays until the FIB forgets the interface
+    router->ifs[ifindex].used = false;
+    for (uint32_t i = router->route_count; i-- > 0;) {
+        pim_route_t *route = router->routes[i];
+        route->joined &= ~PIM_BIT(ifindex);
+        route->local &= ~PIM_BIT(ifindex);
+        if (route->upstream_if == ifindex) {
+            route->upstream_joined = false;
+            pim_route_resolve(router, route);
+        }
+        pim_route_update(router, i);
+    }
+    memset(&router->ifs[ifindex], 0, sizeof(pim_if_t));
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Map a group range to an RP
+ *
+ * @param router Router
+ * @param prefix Group range
+ * @param prefix_len Its length
+ * @param rp RP address
+ * @return status_t Status code
+ */
+status_t pim_rp_add(pim_router_t *router, uint32_t prefix, uint8_t prefix_len, uint32_t rp) {
+    pim_rp_t *slot = NULL;
+
+    if (!router || prefix_len < 4 || prefix_len > 32 || rp == 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    prefix &= 0xFFFFFFFFu << (32 - prefix_len);
+    if (!pim_is_multicast(prefix)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    for (uint32_t i = 0; i < PIM_MAX_RPS; i++) {
+        pim_rp_t *r = &router->rps[i];
+        if (r->used && r->prefix == prefix && r->prefix_len == prefix_len) {
+            slot = r;
+            break;
+        }
+        if (!r->used && !slot) {
+            slot = r;
+        }
+    }
+    if (!slot) {
+        return STATUS_RESOURCE_EXHAUSTED;
+    }
+    slot->used = true;
+    slot->prefix = prefix;
+    slot->prefix_len = prefix_len;
+    slot->rp = rp;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Remove a group range
+ *
+ * @param router Router
+ * @param prefix Group range
+ * @param prefix_len Its length
+ * @return status_t Status code
+ */
+status_t pim_rp_remove(pim_router_t *router, uint32_t prefix, uint8_t prefix_len) {
+    if (!router || prefix_len < 4 || prefix_len > 32) {
+        return STATUS_NOT_FOUND;
+    }
+    prefix &= 0xFFFFFFFFu << (32 - prefix_len);
+
+    for (uint32_t i = 0; i < PIM_MAX_RPS; i++) {
+        pim_rp_t *r = &router->rps[i];
+        if (r->used && r->prefix == prefix && r->prefix_len == prefix_len) {
+            memset(r, 0, sizeof(*r));
+            return STATUS_SUCCESS;
+        }
+    }
+    return STATUS_NOT_FOUND;
+}
+
+/**
+ * @brief Report local members of a group on an interface
+ *
+ * @param router Router
+ * @param ifindex Interface
+ * @param source Source, 0 for any
+ * @param group Group
+ * @param join Whether members joined or left
+ * @return status_t Status code
+ */
+status_t pim_local_membership(pim_router_t *router, uint32_t ifindex, uint32_t source, uint32_t group,
+                              bool join) {
+    uint32_t pos;
+
+    if (!router || ifindex >= PIM_MAX_INTERFACES || !router->ifs[ifindex].used) {
+        return STATUS_NOT_FOUND;
+    }
+    if (!pim_is_multicast(group)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (join) {
+        uint32_t rp = pim_rp_lookup(router, group);
+        if (source == 0 && rp == 0) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        pim_route_t *route = pim_route_get_or_create(router, source, group, rp);
+        if (!route) {
+            return STATUS_NO_MEMORY;
+        }
+        route->local |= PIM_BIT(ifindex);
+    } else {
+        if (!pim_route_find(router, source, group, &pos)) {
+            return STATUS_NOT_FOUND;
+        }
+        router->routes[pos]->local &= ~PIM_BIT(ifindex);
+    }
+
+    if (pim_route_find(router, source, group, &pos)) {
+        pim_route_update(router, pos);
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Process one PIM message
+ *
+ * @param router Router
+ * @param ifindex Receiving interface
+ * @param src Sender
+ * @param msg Message
+ * @param length Its length
+ * @param now_ms Current time
+ * @return status_t Status code
+ */
+status_t pim_input(pim_router_t *router, uint32_t ifindex, uint32_t src, const uint8_t *msg, uint16_t length,
+                   uint64_t now_ms) {
+    if (!router || ifindex >= PIM_MAX_INTERFACES || !router->ifs[ifindex].used) {
+        return STATUS_NOT_FOUND;
+    }
+    if (!msg || length < PIM_HEADER_LEN || (msg[0] >> 4) != PIM_VERSION) {
+        router->stats.malformed++;
+        return STATUS_INVALID_PACKET;
+    }
+
+    uint8_t type = msg[0] & 0x0F;
+    if (type != PIM_MSG_HELLO && type != PIM_MSG_JOIN_PRUNE) {
+        router->stats.unsupported++;
+        return STATUS_NOT_SUPPORTED;
+    }
+    if (packet_csum_fold(packet_csum_add(0, msg, length)) != 0) {
+        router->stats.malformed++;
+        return STATUS_INVALID_PACKET;
+    }
+
+    status_t status = type == PIM_MSG_HELLO ? pim_input_hello(router, ifindex, src, msg, length, now_ms) :
+                                              pim_input_join_prune(router, ifindex, msg, length, now_ms);
+    if (status == STATUS_INVALID_PACKET) {
+        router->stats.malformed++;
+    }
+    return status;
+}
+
+/**
+ * @brief Send due Hellos and periodic joins, expire neighbors and join state
+ *
+ * @param router Router
+ * @param now_ms Current time
+ */
+void pim_process_timers(pim_router_t *router, uint64_t now_ms) {
+    bool dr_changed = false;
+
+    if (!router) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < PIM_MAX_INTERFACES; i++) {
+        pim_if_t *itf = &router->ifs[i];
+        if (!itf->used) {
+            continue;
+        }
+
+        bool lost = false;
+        for (uint32_t n = 0; n < PIM_MAX_NEIGHBORS; n++) {
+            if (itf->neighbors[n].used && itf->neighbors[n].expires_ms <= now_ms) {
+                LOG_INFO(LOG_CATEGORY_L3, "PIM: Neighbor %u.%u.%u.%u on interface %u timed out",
+                         IPV4_OCTET1(itf->neighbors[n].address), IPV4_OCTET2(itf->neighbors[n].address),
+                         IPV4_OCTET3(itf->neighbors[n].address), IPV4_OCTET4(itf->neighbors[n].address), i);
+                memset(&itf->neighbors[n], 0, sizeof(pim_neighbor_t));
+                itf->neighbor_count--;
+                lost = true;
+            }
+        }
+        if (lost) {
+            dr_changed |= pim_elect_dr(itf);
+        }
+
+        if (now_ms >= itf->next_hello_ms) {
+            pim_send_hello(router, i, pim_holdtime_s(router->config.hello_period_ms));
+            itf->next_hello_ms = now_ms + router->config.hello_period_ms;
+        }
+    }
+    if (dr_changed) {
+        pim_refresh_all(router);
+    }
+
+    for (uint32_t i = router->route_count; i-- > 0;) {
+        pim_route_t *route = router->routes[i];
+        if (route->next_expiry_ms > now_ms) {
+            continue;
+        }
+
+        uint64_t next = PIM_NEVER;
+        for (uint64_t bits = route->joined; bits; bits &= bits - 1) {
+            uint32_t b = (uint32_t)__builtin_ctzll(bits);
+            if (route->expires_ms[b] <= now_ms) {
+                route->joined &= ~PIM_BIT(b);
+            } else if (route->expires_ms[b] < next) {
+                next = route->expires_ms[b];
+            }
+        }
+        route->next_expiry_ms = next;
+        pim_route_update(router, i);
+    }
+
+    if (now_ms >= router->next_join_ms) {
+        router->next_join_ms = now_ms + router->config.join_prune_period_ms;
+        pim_periodic_joins(router);
+    }
+}
+
+/**
+ * @brief Get the state of an interface
+ *
+ * @param router Router
+ * @param ifindex Interface
+ * @param info State
+ * @return status_t Status code
+ */
+status_t pim_get_interface(const pim_router_t *router, uint32_t ifindex, pim_interface_info_t *info) {
+    if (!router || !info || ifindex >= PIM_MAX_INTERFACES || !router->ifs[ifindex].used) {
+        return STATUS_NOT_FOUND;
+    }
+
+    info->neighbors = router->ifs[ifindex].neighbor_count;
+    info->is_dr = router->ifs[ifindex].is_dr;
+    info->dr_address = router->ifs[ifindex].dr_address;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the state of a route
+ *
+ * @param router Router
+ * @param source Source, 0 for (*,G)
+ * @param group Group
+ * @param info State
+ * @return status_t Status code
+ */
+status_t pim_get_route(const pim_router_t *router, uint32_t source, uint32_t group, pim_route_info_t *info) {
+    uint32_t pos;
+
+    if (!router || !info || !pim_route_find(router, source, group, &pos)) {
+        return STATUS_NOT_FOUND;
+    }
+
+    const pim_route_t *route = router->routes[pos];
+    info->rp = route->rp;
+    info->upstream_if = route->upstream_if;
+    info->upstream_neighbor = route->upstream_joined ? route->upstream_nbr : 0;
+    info->joined = route->joined;
+    info->local = route->local;
+    info->oifs = route->fib_oifs;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get router counters
+ *
+ * @param router Router
+ * @param stats Counters
+ * @return status_t Status code
+ */
+status_t pim_get_stats(const pim_router_t *router, pim_stats_t *stats) {
+    if (!router || !stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    *stats = router->stats;
+    stats->neighbors = 0;
+    for (uint32_t i = 0; i < PIM_MAX_INTERFACES; i++) {
+        stats->neighbors += router->ifs[i].neighbor_count;
+    }
+    stats->routes = router->route_count;
+    return STATUS_SUCCESS;
+}
+
+/* Private functions */
+
+/**
+ * @brief Binary search of the route array
+ *
+ * @param pos Index of the route, or where it would be inserted
+ * @return Whether the route exists
+ */
+static bool pim_route_find(const pim_router_t *router, uint32_t source, uint32_t group, uint32_t *pos) {
+    uint64_t key = ((uint64_t)group << 32) | source;
+    uint32_t lo = 0;
+    uint32_t hi = router->route_count;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const pim_route_t *r = router->routes[mid];
+        uint64_t k = ((uint64_t)r->group << 32) | r->source;
+        if (k < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *pos = lo;
+    return lo < router->route_count && router->routes[lo]->group == group && router->routes[lo]->source == source;
+}
+
+/**
+ * @brief Find a route or insert a new one, resolved but without state
+ */
+static pim_route_t *pim_route_get_or_create(pim_router_t *router, uint32_t source, uint32_t group, uint32_t rp) {
+    uint32_t pos;
+
+    if (pim_route_find(router, source, group, &pos)) {
+        return router->routes[pos];
+    }
+
+    if (router->route_count == router->route_cap) {
+        uint32_t cap = router->route_cap ? router->route_cap * 2 : PIM_INITIAL_ROUTES;
+        pim_route_t **routes = (pim_route_t **)realloc(router->routes, cap * sizeof(pim_route_t *));
+        if (!routes) {
+            LOG_ERROR(LOG_CATEGORY_L3, "PIM: Failed to grow the route array to %u", cap);
+            return NULL;
+        }
+        router->routes = routes;
+        router->route_cap = cap;
+    }
+
+    pim_route_t *route = (pim_route_t *)calloc(1, sizeof(pim_route_t));
+    if (!route) {
+        LOG_ERROR(LOG_CATEGORY_L3, "PIM: Failed to allocate route");
+        return NULL;
+    }
+    route->source = source;
+    route->group = group;
+    route->rp = rp;
+    route->next_expiry_ms = PIM_NEVER;
+    pim_route_resolve(router, route);
+
+    memmove(&router->routes[pos + 1], &router->routes[pos], (router->route_count - pos) * sizeof(pim_route_t *));
+    router->routes[pos] = route;
+    router->route_count++;
+    return route;
+}
+
+/**
+ * @brief Find the RPF interface and upstream neighbor of a route
+ */
+static void pim_route_resolve(pim_router_t *router, pim_route_t *route) {
+    uint32_t target = route->source ? route->source : route->rp;
+    uint32_t ifindex = PIM_NO_INTERFACE;
+    uint32_t neighbor = 0;
+
+    route->upstream_if = PIM_NO_INTERFACE;
+    route->upstream_nbr = 0;
+    route->rpf_ok = false;
+    if (target == 0) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < PIM_MAX_INTERFACES; i++) {
+        if (router->ifs[i].used && router->ifs[i].config.address == target) {
+            // We are the RP (or the source): the tree is rooted here
+            route->rpf_ok = true;
+            return;
+        }
+    }
+
+    if (router->config.rpf(target, &ifindex, &neighbor, router->config.ctx) != STATUS_SUCCESS ||
+        ifindex >= PIM_MAX_INTERFACES || !router->ifs[ifindex].used) {
+        return;
+    }
+    route->upstream_if = ifindex;
+    // A directly connected RP is joined; a directly connected source is not a router
+    route->upstream_nbr = neighbor ? neighbor : (route->source ? 0 : target);
+    route->rpf_ok = true;
+}
+
+/**
+ * @brief Interfaces a route has state of its own on
+ */
+static uint64_t pim_route_own(const pim_router_t *router, const pim_route_t *route) {
+    uint64_t dr = 0;
+
+    for (uint64_t bits = route->local; bits; bits &= bits - 1) {
+        uint32_t b = (uint32_t)__builtin_ctzll(bits);
+        if (router->ifs[b].is_dr) {
+            dr |= PIM_BIT(b);
+        }
+    }
+    return (route->joined | dr) & pim_used_mask(router);
+}
+
+/**
+ * @brief Bring the FIB in line with a route: incoming interface and the difference of the replication list
+ */
+static void pim_route_program(pim_router_t *router, pim_route_t *route) {
+    uint64_t wanted = 0;
+
+    if (route->rpf_ok) {
+        wanted = pim_route_own(router, route);
+        if (route->source) {
+            uint32_t pos;
+            if (pim_route_find(router, 0, route->group, &pos)) {
+                wanted |= pim_route_own(router, router->routes[pos]);
+            }
+        }
+        if (route->upstream_if != PIM_NO_INTERFACE) {
+            wanted &= ~PIM_BIT(route->upstream_if);
+        }
+    }
+
+    if (!wanted) {
+        if (route->programmed && mfib_route_delete(route->source, route->group) != STATUS_SUCCESS) {
+            router->stats.fib_errors++;
+        }
+        route->programmed = false;
+        route->fib_oifs = 0;
+        return;
+    }
+
+    port_id_t iif = PORT_ID_INVALID;
+    vlan_id_t iif_vlan = 0;
+    if (route->upstream_if != PIM_NO_INTERFACE) {
+        iif = router->ifs[route->upstream_if].config.port_id;
+        iif_vlan = router->ifs[route->upstream_if].config.vlan_id;
+    }
+    if (mfib_route_add(route->source, route->group, iif, iif_vlan) != STATUS_SUCCESS) {
+        router->stats.fib_errors++;
+        return;
+    }
+    route->programmed = true;
+
+    for (uint64_t bits = route->fib_oifs & ~wanted; bits; bits &= bits - 1) {
+        uint32_t b = (uint32_t)__builtin_ctzll(bits);
+        const pim_interface_config_t *c = &router->ifs[b].config;
+        if (mfib_oif_remove(route->source, route->group, c->port_id, c->vlan_id) != STATUS_SUCCESS) {
+            router->stats.fib_errors++;
+        }
+        route->fib_oifs &= ~PIM_BIT(b);
+    }
+    for (uint64_t bits = wanted & ~route->fib_oifs; bits; bits &= bits - 1) {
+        uint32_t b = (uint32_t)__builtin_ctzll(bits);
+        const pim_interface_config_t *c = &router->ifs[b].config;
+        mfib_oif_t oif = { .port_id = c->port_id, .vlan_id = c->vlan_id, .tagged = c->tagged, .src_mac = c->mac };
+        if (mfib_oif_add(route->source, route->group, &oif) != STATUS_SUCCESS) {
+            router->stats.fib_errors++;
+            continue;
+        }
+        route->fib_oifs |= PIM_BIT(b);
+    }
+}
+
+/**
+ * @brief Act on a change of a route's state: upstream join or prune, FIB, dependent (S,G) routes
+ *
+ * A route left without state of its own is deleted, so pointers into the
+ * route array are stale afterwards; only higher indexes move.
+ */
+static void pim_route_update(pim_router_t *router, uint32_t pos) {
+    pim_route_t *route = router->routes[pos];
+    bool active = pim_route_own(router, route) != 0;
+
+    if (active && !route->upstream_joined && route->upstream_nbr) {
+        pim_send_join_prune(router, route, true);
+        route->upstream_joined = true;
+    } else if (!active && route->upstream_joined) {
+        pim_send_join_prune(router, route, false);
+        route->upstream_joined = false;
+    }
+
+    pim_route_program(router, route);
+    if (route->source == 0) {
+        for (uint32_t i = pos + 1; i < router->route_count && router->routes[i]->group == route->group; i++) {
+            pim_route_program(router, router->routes[i]);
+        }
+    }
+
+    if (!active) {
+        free(route);
+        router->route_count--;
+        memmove(&router->routes[pos], &router->routes[pos + 1], (router->route_count - pos) * sizeof(pim_route_t *));
+    }
+}
+
+/**
+ * @brief Re-evaluate every route, e.g. after a DR change
+ */
+static void pim_refresh_all(pim_router_t *router) {
+    for (uint32_t i = router->route_count; i-- > 0;) {
+        pim_route_update(router, i);
+    }
+}
+
+/**
+ * @brief RP of the longest group range holding group, 0 if none
+ */
+static uint32_t pim_rp_lookup(const pim_router_t *router, uint32_t group) {
+    uint32_t rp = 0;
+    int best = -1;
+
+    for (uint32_t i = 0; i < PIM_MAX_RPS; i++) {
+        const pim_rp_t *r = &router->rps[i];
+        if (r->used && r->prefix_len > best &&
+            (group & (0xFFFFFFFFu << (32 - r->prefix_len))) == r->prefix) {
+            best = r->prefix_len;
+            rp = r->rp;
+        }
+    }
+    return rp;
+}
+
+/**
+ * @brief Elect the DR of an interface: highest priority, then highest address
+ *
+ * Priorities count only if every neighbor sends one (RFC 7761 4.3.2).
+ *
+ * @return Whether the router's DR role changed
+ */
+static bool pim_elect_dr(pim_if_t *itf) {
+    bool use_priority = true;
+    uint32_t dr = itf->config.address;
+    uint32_t dr_priority = itf->config.dr_priority;
+    bool was_dr = itf->is_dr;
+
+    for (uint32_t n = 0; n < PIM_MAX_NEIGHBORS; n++) {
+        if (itf->neighbors[n].used && !itf->neighbors[n].has_dr_priority) {
+            use_priority = false;
+        }
+    }
+    for (uint32_t n = 0; n < PIM_MAX_NEIGHBORS; n++) {
+        const pim_neighbor_t *nbr = &itf->neighbors[n];
+        if (!nbr->used) {
+            continue;
+        }
+        if ((use_priority && nbr->dr_priority > dr_priority) ||
+            ((!use_priority || nbr->dr_priority == dr_priority) && nbr->address > dr)) {
+            dr = nbr->address;
+            dr_priority = nbr->dr_priority;
+        }
+    }
+
+    itf->dr_address = dr;
+    itf->is_dr = dr == itf->config.address;
+    return itf->is_dr != was_dr;
+}
+
+/**
+ * @brief Fill in the checksum of a message and send it to ALL-PIM-ROUTERS
+ */
+static void pim_send(pim_router_t *router, uint32_t ifindex, uint8_t *msg, uint16_t length) {
+    pim_write16(msg + 2, 0);
+    pim_write16(msg + 2, packet_csum_fold(packet_csum_add(0, msg, length)));
+    if (router->config.send(ifindex, PIM_ALL_ROUTERS, msg, length, router->config.ctx) != STATUS_SUCCESS) {
+        LOG_DEBUG(LOG_CATEGORY_L3, "PIM: Failed to send a message on interface %u", ifindex);
+    }
+}
+
+/**
+ * @brief Send a Hello with holdtime, DR priority and generation ID options
+ */
+static void pim_send_hello(pim_router_t *router, uint32_t ifindex, uint16_t holdtime) {
+    uint8_t msg[PIM_HEADER_LEN + 6 + 8 + 8];
+    uint8_t *p = msg + PIM_HEADER_LEN;
+
+    msg[0] = (PIM_VERSION << 4) | PIM_MSG_HELLO;
+    msg[1] = 0;
+    pim_write16(p, PIM_OPT_HOLDTIME);
+    pim_write16(p + 2, 2);
+    pim_write16(p + 4, holdtime);
+    p += 6;
+    pim_write16(p, PIM_OPT_DR_PRIORITY);
+    pim_write16(p + 2, 4);
+    pim_write32(p + 4, router->ifs[ifindex].config.dr_priority);
+    p += 8;
+    pim_write16(p, PIM_OPT_GENERATION_ID);
+    pim_write16(p + 2, 4);
+    pim_write32(p + 4, router->generation_id);
+
+    pim_send(router, ifindex, msg, sizeof(msg));
+    router->stats.hellos_tx++;
+}
+
+/**
+ * @brief Start a Join/Prune message to an upstream neighbor
+ */
+static void pim_jp_begin(pim_router_t *router, uint32_t ifindex, uint32_t neighbor) {
+    pim_jp_t *jp = &router->jp;
+    uint8_t *p = jp->buf;
+
+    jp->ifindex = ifindex;
+    jp->neighbor = neighbor;
+    jp->groups = 0;
+    jp->group_off = 0;
+    p[0] = (PIM_VERSION << 4) | PIM_MSG_JOIN_PRUNE;
+    p[1] = 0;
+    p += PIM_HEADER_LEN;
+    p[0] = PIM_ADDR_FAMILY_IPV4;
+    p[1] = PIM_ENCODING_NATIVE;
+    pim_write32(p + 2, neighbor);
+    p += PIM_ENC_UNICAST_LEN;
+    p[0] = 0;
+    p[1] = 0;
+    pim_write16(p + 2, pim_holdtime_s(router->config.join_prune_period_ms));
+    jp->len = PIM_JP_HEADER_LEN;
+}
+
+/**
+ * @brief Add the join or prune of a route, into the current group record when it can take it
+ *
+ * Joined sources precede pruned ones in a record, so a join opens a new
+ * record after a prune of the same group.
+ */
+static void pim_jp_add(pim_router_t *router, const pim_route_t *route, bool join) {
+    pim_jp_t *jp = &router->jp;
+    bool same = jp->group_off && jp->group == route->group && (!join || jp->pruned == 0);
+
+    if (jp->len + PIM_ENC_SOURCE_LEN + (same ? 0 : PIM_JP_GROUP_LEN) > PIM_MAX_MESSAGE_LEN ||
+        (!same && jp->groups == PIM_JP_MAX_GROUPS)) {
+        pim_jp_flush(router);
+        same = false;
+    }
+
+    if (!same) {
+        uint8_t *g = jp->buf + jp->len;
+        g[0] = PIM_ADDR_FAMILY_IPV4;
+        g[1] = PIM_ENCODING_NATIVE;
+        g[2] = 0;
+        g[3] = 32;
+        pim_write32(g + 4, route->group);
+        pim_write16(g + 8, 0);
+        pim_write16(g + 10, 0);
+        jp->group_off = jp->len;
+        jp->group = route->group;
+        jp->joined = 0;
+        jp->pruned = 0;
+        jp->groups++;
+        jp->len += PIM_JP_GROUP_LEN;
+    }
+
+    uint8_t *s = jp->buf + jp->len;
+    s[0] = PIM_ADDR_FAMILY_IPV4;
+    s[1] = PIM_ENCODING_NATIVE;
+    s[2] = route->source ? PIM_SRC_SPARSE : (PIM_SRC_SPARSE | PIM_SRC_WILDCARD | PIM_SRC_RPT);
+    s[3] = 32;
+    pim_write32(s + 4, route->source ? route->source : route->rp);
+    jp->len += PIM_ENC_SOURCE_LEN;
+
+    if (join) {
+        jp->joined++;
+    } else {
+        jp->pruned++;
+    }
+    pim_write16(jp->buf + jp->group_off + PIM_ENC_GROUP_LEN, jp->joined);
+    pim_write16(jp->buf + jp->group_off + PIM_ENC_GROUP_LEN + 2, jp->pruned);
+}
+
+/**
+ * @brief Send the message under construction, if it has groups, and start the next one
+ */
+static void pim_jp_flush(pim_router_t *router) {
+    pim_jp_t *jp = &router->jp;
+
+    if (jp->groups) {
+        jp->buf[PIM_HEADER_LEN + PIM_ENC_UNICAST_LEN + 1] = (uint8_t)jp->groups;
+        pim_send(router, jp->ifindex, jp->buf, jp->len);
+        router->stats.join_prunes_tx++;
+    }
+    pim_jp_begin(router, jp->ifindex, jp->neighbor);
+}
+
+/**
+ * @brief Send a triggered join or prune of one route to its upstream neighbor
+ */
+static void pim_send_join_prune(pim_router_t *router, const pim_route_t *route, bool join) {
+    if (route->upstream_if == PIM_NO_INTERFACE || !route->upstream_nbr) {
+        return;
+    }
+    pim_jp_begin(router, route->upstream_if, route->upstream_nbr);
+    pim_jp_add(router, route, join);
+    pim_jp_flush(router);
+}
+
+static int pim_jp_cmp(const void *a, const void *b) {
+    const pim_route_t *x = *(const pim_route_t *const *)a;
+    const pim_route_t *y = *(const pim_route_t *const *)b;
+
+    if (x->upstream_if != y->upstream_if) {
+        return x->upstream_if < y->upstream_if ? -1 : 1;
+    }
+    if (x->upstream_nbr != y->upstream_nbr) {
+        return x->upstream_nbr < y->upstream_nbr ? -1 : 1;
+    }
+    if (x->group != y->group) {
+        return x->group < y->group ? -1 : 1;
+    }
+    return x->source < y->source ? -1 : x->source > y->source;
+}
+
+/**
+ * @brief Re-check the RPF of every route, then refresh every upstream join in packed messages
+ */
+static void pim_periodic_joins(pim_router_t *router) {
+    for (uint32_t i = router->route_count; i-- > 0;) {
+        pim_route_t *route = router->routes[i];
+        uint32_t old_if = route->upstream_if;
+        uint32_t old_nbr = route->upstream_nbr;
+
+        pim_route_resolve(router, route);
+        if (route->upstream_if == old_if && route->upstream_nbr == old_nbr) {
+            continue;
+        }
+        if (route->upstream_joined) {
+            // Prune the old branch; the update joins the new one
+            pim_route_t old = *route;
+            old.upstream_if = old_if;
+            old.upstream_nbr = old_nbr;
+            pim_send_join_prune(router, &old, false);
+            route->upstream_joined = false;
+        }
+        pim_route_update(router, i);
+    }
+
+    if (router->route_count == 0) {
+        return;
+    }
+    pim_route_t **due = (pim_route_t **)malloc(router->route_count * sizeof(pim_route_t *));
+    if (!due) {
+        LOG_ERROR(LOG_CATEGORY_L3, "PIM: No memory for periodic joins");
+        return;
+    }
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < router->route_count; i++) {
+        if (router->routes[i]->upstream_joined) {
+            due[count++] = router->routes[i];
+        }
+    }
+    qsort(due, count, sizeof(pim_route_t *), pim_jp_cmp);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (i == 0 || due[i]->upstream_if != due[i - 1]->upstream_if ||
+            due[i]->upstream_nbr != due[i - 1]->upstream_nbr) {
+            if (i) {
+                pim_jp_flush(router);
+            }
+            pim_jp_begin(router, due[i]->upstream_if, due[i]->upstream_nbr);
+        }
+        pim_jp_add(router, due[i], true);
+    }
+    if (count) {
+        pim_jp_flush(router);
+    }
+    free(due);
+}
+
+/**
+ * @brief Process a Hello: neighbor, its options, DR election
+ */
+static status_t pim_input_hello(pim_router_t *router, uint32_t ifindex, uint32_t src, const uint8_t *msg,
+                                uint16_t length, uint64_t now_ms) {
+    pim_if_t *itf = &router->ifs[ifindex];
+    uint32_t holdtime = PIM_DEFAULT_HOLDTIME_S;
+    bool has_dr_priority = false;
+    uint32_t dr_priority = 0;
+    uint32_t generation_id = 0;
+
+    router->stats.hellos_rx++;
+    for (uint16_t off = PIM_HEADER_LEN; off < length;) {
+        if (off + 4 > length) {
+            return STATUS_INVALID_PACKET;
+        }
+        uint16_t type = pim_read16(msg + off);
+        uint16_t len = pim_read16(msg + off + 2);
+        const uint8_t *value = msg + off + 4;
+        if (off + 4 + len > length) {
+            return STATUS_INVALID_PACKET;
+        }
+        if (type == PIM_OPT_HOLDTIME && len == 2) {
+            holdtime = pim_read16(value);
+        } else if (type == PIM_OPT_DR_PRIORITY && len == 4) {
+            has_dr_priority = true;
+            dr_priority = pim_read32(value);
+        } else if (type == PIM_OPT_GENERATION_ID && len == 4) {
+            generation_id = pim_read32(value);
+        }
+        off = (uint16_t)(off + 4 + len);
+    }
+
+    pim_neighbor_t *nbr = NULL;
+    pim_neighbor_t *free_slot = NULL;
+    for (uint32_t n = 0; n < PIM_MAX_NEIGHBORS; n++) {
+        if (itf->neighbors[n].used && itf->neighbors[n].address == src) {
+            nbr = &itf->neighbors[n];
+            break;
+        }
+        if (!itf->neighbors[n].used && !free_slot) {
+            free_slot = &itf->neighbors[n];
+        }
+    }
+
+    if (holdtime == 0) {
+        // The neighbor is going away
+        if (nbr) {
+            memset(nbr, 0, sizeof(*nbr));
+            itf->neighbor_count--;
+            if (pim_elect_dr(itf)) {
+                pim_refresh_all(router);
+            }
+        }
+        return STATUS_SUCCESS;
+    }
+
+    bool restarted = false;
+    if (!nbr) {
+        if (!free_slot) {
+            LOG_WARNING(LOG_CATEGORY_L3, "PIM: Too many neighbors on interface %u", ifindex);
+            return STATUS_RESOURCE_EXHAUSTED;
+        }
+        nbr = free_slot;
+        nbr->used = true;
+        nbr->address = src;
+        itf->neighbor_count++;
+        restarted = true;
+        LOG_INFO(LOG_CATEGORY_L3, "PIM: New neighbor %u.%u.%u.%u on interface %u",
+                 IPV4_OCTET1(src), IPV4_OCTET2(src), IPV4_OCTET3(src), IPV4_OCTET4(src), ifindex);
+    } else if (nbr->generation_id != generation_id) {
+        restarted = true;
+    }
+    nbr->has_dr_priority = has_dr_priority;
+    nbr->dr_priority = dr_priority;
+    nbr->generation_id = generation_id;
+    nbr->expires_ms = holdtime == PIM_HOLDTIME_INFINITE ? PIM_NEVER : now_ms + holdtime * PIM_MS_PER_S;
+
+    if (restarted) {
+        // A new or restarted neighbor has no state from us: Hello and joins go at the next timer run
+        itf->next_hello_ms = now_ms;
+        router->next_join_ms = now_ms;
+    }
+    if (pim_elect_dr(itf)) {
+        pim_refresh_all(router);
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Process a Join/Prune: downstream state for messages to us, prune override otherwise
+ */
+static status_t pim_input_join_prune(pim_router_t *router, uint32_t ifindex, const uint8_t *msg,
+                                     uint16_t length, uint64_t now_ms) {
+    pim_if_t *itf = &router->ifs[ifindex];
+
+    if (length < PIM_JP_HEADER_LEN) {
+        return STATUS_INVALID_PACKET;
+    }
+    const uint8_t *p = msg + PIM_HEADER_LEN;
+    if (p[0] != PIM_ADDR_FAMILY_IPV4 || p[1] != PIM_ENCODING_NATIVE) {
+        return STATUS_INVALID_PACKET;
+    }
+    uint32_t upstream = pim_read32(p + 2);
+    p += PIM_ENC_UNICAST_LEN;
+    uint8_t groups = p[1];
+    uint16_t holdtime = pim_read16(p + 2);
+    uint16_t off = PIM_JP_HEADER_LEN;
+    bool to_us = upstream == itf->config.address;
+
+    router->stats.join_prunes_rx++;
+    for (uint8_t g = 0; g < groups; g++) {
+        if (off + PIM_JP_GROUP_LEN > length) {
+            return STATUS_INVALID_PACKET;
+        }
+        const uint8_t *rec = msg + off;
+        uint32_t group = pim_read32(rec + 4);
+        uint16_t joined = pim_read16(rec + PIM_ENC_GROUP_LEN);
+        uint16_t pruned = pim_read16(rec + PIM_ENC_GROUP_LEN + 2);
+        off = (uint16_t)(off + PIM_JP_GROUP_LEN);
+        if ((uint32_t)off + (uint32_t)(joined + pruned) * PIM_ENC_SOURCE_LEN > length) {
+            return STATUS_INVALID_PACKET;
+        }
+        if (rec[0] != PIM_ADDR_FAMILY_IPV4 || rec[3] != 32 || !pim_is_multicast(group)) {
+            off = (uint16_t)(off + (joined + pruned) * PIM_ENC_SOURCE_LEN);
+            continue;
+        }
+
+        for (uint32_t e = 0; e < (uint32_t)joined + pruned; e++, off = (uint16_t)(off + PIM_ENC_SOURCE_LEN)) {
+            const uint8_t *s = msg + off;
+            bool join = e < joined && holdtime != 0;
+            uint8_t flags = s[2];
+            uint32_t addr = pim_read32(s + 4);
+            uint32_t source;
+            uint32_t pos;
+
+            if (s[0] != PIM_ADDR_FAMILY_IPV4 || s[3] != 32) {
+                continue;
+            }
+            if ((flags & (PIM_SRC_WILDCARD | PIM_SRC_RPT)) == (PIM_SRC_WILDCARD | PIM_SRC_RPT)) {
+                source = 0;
+            } else if (!(flags & (PIM_SRC_WILDCARD | PIM_SRC_RPT))) {
+                source = addr;
+            } else {
+                // (S,G,rpt) prunes only matter with SPT switchover
+                continue;
+            }
+
+            if (!to_us) {
+                // Someone prunes a branch we are joined to on this LAN: override with a join
+                if (!join && pim_route_find(router, source, group, &pos)) {
+                    pim_route_t *route = router->routes[pos];
+                    if (route->upstream_joined && route->upstream_if == ifindex && route->upstream_nbr == upstream) {
+                        pim_send_join_prune(router, route, true);
+                    }
+                }
+                continue;
+            }
+
+            if (join) {
+                router->stats.joins_rx++;
+                uint32_t rp = pim_rp_lookup(router, group);
+                if (source == 0 && rp == 0) {
+                    rp = addr;
+                }
+                pim_route_t *route = pim_route_get_or_create(router, source, group, rp);
+                if (!route) {
+                    return STATUS_NO_MEMORY;
+                }
+                uint64_t expires = holdtime == PIM_HOLDTIME_INFINITE ? PIM_NEVER :
+                                   now_ms + holdtime * PIM_MS_PER_S;
+                route->joined |= PIM_BIT(ifindex);
+                route->expires_ms[ifindex] = expires;
+                if (expires < route->next_expiry_ms) {
+                    route->next_expiry_ms = expires;
+                }
+            } else {
+                router->stats.prunes_rx++;
+                if (!pim_route_find(router, source, group, &pos) ||
+                    !(router->routes[pos]->joined & PIM_BIT(ifindex))) {
+                    continue;
+                }
+                pim_route_t *route = router->routes[pos];
+                if (itf->neighbor_count > 1) {
+                    // Another router on the LAN may still want it: wait for its override
+                    uint64_t expires = now_ms + PIM_JP_OVERRIDE_MS;
+                    if (expires < route->expires_ms[ifindex]) {
+                        route->expires_ms[ifindex] = expires;
+                    }
+                    if (expires < route->next_expiry_ms) {
+                        route->next_expiry_ms = expires;
+                    }
+                    continue;
+                }
+                route->joined &= ~PIM_BIT(ifindex);
+            }
+
+            if (pim_route_find(router, source, group, &pos)) {
+                pim_route_update(router, pos);
+            }
+        }
+    }
+    return STATUS_SUCCESS;
+}
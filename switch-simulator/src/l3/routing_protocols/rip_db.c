@@ -0,0 +1,502 @@
+/**
+ * @file rip_db.c
+ * @brief Implementation of the hashed RIP route database
+ *
+ * Routes are chained in a hash table that doubles when it is full, and
+ * linked into the timing wheel bucket of their deadline. No deadline is
+ * more than RIP_DB_TIMEOUT ahead, so a bucket only ever holds the routes
+ * of a single second; a catch-up after a long stall visits every bucket
+ * once and keeps what is not due yet. Changed routes are also chained on
+ * a list that the next update walks.
+ */
+
+#include "l3/rip_db.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Defines */
+#define RIP_DB_INITIAL_BUCKETS  256
+#define RIP_DB_WHEEL_SIZE       256     /* Seconds, a power of two above the timeout */
+#define RIP_DB_WHEEL_MASK       (RIP_DB_WHEEL_SIZE - 1)
+
+/* Where a route is linked on the wheel side */
+enum {
+    RIP_DB_WHEEL_QUEUED = 1,        /* In the bucket of its deadline */
+    RIP_DB_WHEEL_HELD,              /* Set aside while its bucket is visited */
+    RIP_DB_WHEEL_PARKED             /* Deadline reported, in no list */
+};
+
+/* Private data types */
+
+/* Route database of one RIP instance */
+struct rip_db {
+    rip_db_route_t **buckets;
+    uint32_t bucket_mask;
+    uint32_t count;
+    rip_db_route_t *wheel[RIP_DB_WHEEL_SIZE];
+    rip_db_route_t *held;           /* Routes of the visited bucket that are not due */
+    uint32_t next_tick;             /* First second not expired yet */
+    rip_db_route_t *changed;        /* Routes for the next triggered update */
+    uint32_t holdoff_end;           /* No triggered update before this second */
+    uint32_t rand_state;
+};
+
+/* Forward declarations of private functions */
+static uint32_t rip_db_hash(uint32_t destination, uint32_t mask);
+static rip_db_route_t **rip_db_slot(const rip_db_t *db, uint32_t destination, uint32_t mask);
+static bool rip_db_grow(rip_db_t *db);
+static void rip_db_link(rip_db_route_t **head, rip_db_route_t *route);
+static void rip_db_unlink(rip_db_t *db, rip_db_route_t *route);
+static void rip_db_schedule(rip_db_t *db, rip_db_route_t *route, uint32_t deadline);
+static void rip_db_mark_changed(rip_db_t *db, rip_db_route_t *route);
+static void rip_db_delete(rip_db_t *db, rip_db_route_t *route);
+static bool rip_db_due(uint32_t deadline, uint32_t now);
+
+/**
+ * @brief Create an empty database
+ *
+ * @param now Current time, seconds
+ * @param seed Seed of the triggered update hold-off
+ * @return New database, or NULL if out of memory
+ */
+rip_db_t *rip_db_create(uint32_t now, uint32_t seed) {
+    rip_db_t *db = calloc(1, sizeof(*db));
+    if (!db) {
+        return NULL;
+    }
+
+    db->buckets = calloc(RIP_DB_INITIAL_BUCKETS, sizeof(*db->buckets));
+    if (!db->buckets) {
+        free(db);
+        return NULL;
+    }
+    db->bucket_mask = RIP_DB_INITIAL_BUCKETS - 1;
+    db->next_tick = now;
+    db->holdoff_end = now;
+    db->rand_state = seed ? seed : 0x2545f491;
+    return db;
+}
+
+/**
+ * @brief Free a database and its routes
+ *
+ * @param db Database, may be NULL
+ */
+void rip_db_destroy(rip_db_t *db) {
+    if (!db) {
+        return;
+    }
+
+    for (uint32_t i = 0; i <= db->bucket_mask; i++) {
+        rip_db_route_t *route = db->buckets[i];
+        while (route) {
+            rip_db_route_t *next = route->hash_next;
+            free(route);
+            route = next;
+        }
+    }
+    free(db->buckets);
+    free(db);
+}
+
+/**
+ * @brief Apply one RTE of a Response (RFC 2453 3.9.2)
+ *
+ * @param db Database
+ * @param rte Entry, next_hop resolved to the sender if it was 0
+ * @param interface_index Interface the Response came in on
+ * @param now Current time, seconds
+ * @param[out] change What the FIB should do, may be NULL
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER, STATUS_NO_MEMORY
+ */
+status_t rip_db_update(rip_db_t *db, const rip_db_rte_t *rte, uint32_t interface_index,
+                       uint32_t now, rip_db_change_t *change) {
+    rip_db_change_t result = RIP_DB_UNCHANGED;
+
+    if (change) {
+        *change = RIP_DB_UNCHANGED;
+    }
+    if (!db || !rte || rte->metric < 1 || (rte->destination & ~rte->mask) != 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    uint32_t metric = rte->metric < RIP_DB_INFINITY ? rte->metric : RIP_DB_INFINITY;
+
+    rip_db_route_t **slot = rip_db_slot(db, rte->destination, rte->mask);
+    rip_db_route_t *route = *slot;
+    if (!route) {
+        /* An unreachable route that is not known is not worth keeping */
+        if (metric == RIP_DB_INFINITY) {
+            return STATUS_SUCCESS;
+        }
+        if (db->count > db->bucket_mask && rip_db_grow(db)) {
+            slot = rip_db_slot(db, rte->destination, rte->mask);
+        }
+        route = calloc(1, sizeof(*route));
+        if (!route) {
+            return STATUS_NO_MEMORY;
+        }
+        route->destination = rte->destination;
+        route->mask = rte->mask;
+        route->next_hop = rte->next_hop;
+        route->metric = metric;
+        route->interface_index = interface_index;
+        route->valid = true;
+        *slot = route;
+        db->count++;
+        rip_db_schedule(db, route, now + RIP_DB_TIMEOUT);
+        rip_db_mark_changed(db, route);
+        result = RIP_DB_ADDED;
+    } else {
+        bool same_router = route->next_hop == rte->next_hop;
+
+        if ((same_router && metric != route->metric) || metric < route->metric) {
+            route->next_hop = rte->next_hop;
+            route->metric = metric;
+            route->interface_index = interface_index;
+            if (metric == RIP_DB_INFINITY) {
+                /* Start the deletion; the neighbors learn it at once */
+                if (route->valid) {
+                    route->valid = false;
+                    rip_db_schedule(db, route, now + RIP_DB_GARBAGE_TIME);
+                    result = RIP_DB_WITHDRAWN;
+                }
+            } else {
+                result = route->valid ? RIP_DB_CHANGED : RIP_DB_ADDED;
+                route->valid = true;
+                rip_db_schedule(db, route, now + RIP_DB_TIMEOUT);
+            }
+            rip_db_mark_changed(db, route);
+        } else if (same_router && route->valid) {
+            rip_db_schedule(db, route, now + RIP_DB_TIMEOUT);
+        }
+    }
+
+    if (change) {
+        *change = result;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Find a route
+ *
+ * @param db Database
+ * @param destination Destination, host order
+ * @param mask Mask, host order
+ * @return The route, NULL if unknown; valid until it is deleted
+ */
+const rip_db_route_t *rip_db_lookup(const rip_db_t *db, uint32_t destination, uint32_t mask) {
+    if (!db) {
+        return NULL;
+    }
+    return *rip_db_slot(db, destination, mask);
+}
+
+/**
+ * @brief Time out and delete the routes whose deadlines passed
+ *
+ * @param db Database
+ * @param now Current time, seconds
+ * @param cb Called for each deadline, may be NULL
+ * @param ctx Passed to cb
+ * @return Number of deadlines reported
+ */
+uint32_t rip_db_expire(rip_db_t *db, uint32_t now, rip_db_expire_cb_t cb, void *ctx) {
+    uint32_t reported = 0;
+
+    if (!db || !rip_db_due(db->next_tick, now)) {
+        return 0;
+    }
+
+    /* After a stall every bucket is visited once */
+    uint32_t ticks = now - db->next_tick + 1;
+    if (ticks > RIP_DB_WHEEL_SIZE) {
+        ticks = RIP_DB_WHEEL_SIZE;
+    }
+    uint32_t tick = now - ticks + 1;
+    db->next_tick = now + 1;
+
+    for (uint32_t t = 0; t < ticks; t++, tick++) {
+        rip_db_route_t **bucket = &db->wheel[tick & RIP_DB_WHEEL_MASK];
+        rip_db_route_t *route;
+
+        while ((route = *bucket) != NULL) {
+            rip_db_unlink(db, route);
+            if (!rip_db_due(route->deadline, now)) {
+                rip_db_link(&db->held, route);
+                route->wheel_state = RIP_DB_WHEEL_HELD;
+                continue;
+            }
+
+            if (route->valid) {
+                route->valid = false;
+                route->metric = RIP_DB_INFINITY;
+                rip_db_schedule(db, route, now + RIP_DB_GARBAGE_TIME);
+                rip_db_mark_changed(db, route);
+                if (cb) {
+                    cb(route, RIP_DB_EVENT_TIMEOUT, ctx);
+                }
+            } else {
+                route->wheel_state = RIP_DB_WHEEL_PARKED;
+                if (cb) {
+                    cb(route, RIP_DB_EVENT_DELETE, ctx);
+                }
+                rip_db_delete(db, route);
+            }
+            reported++;
+        }
+
+        while ((route = db->held) != NULL) {
+            rip_db_unlink(db, route);
+            rip_db_link(bucket, route);
+            route->wheel_state = RIP_DB_WHEEL_QUEUED;
+        }
+    }
+
+    return reported;
+}
+
+/**
+ * @brief Check whether a triggered update should go out now
+ *
+ * @param db Database
+ * @param now Current time, seconds
+ * @return true if routes changed and the hold-off is over
+ */
+bool rip_db_trigger_due(const rip_db_t *db, uint32_t now) {
+    return db && db->changed && rip_db_due(db->holdoff_end, now);
+}
+
+/**
+ * @brief Send the routes to one interface as a burst of Responses
+ *
+ * @param db Database
+ * @param interface_index Interface to send on
+ * @param changed_only Send only the routes changed since the last update
+ * @param send Called for each Response
+ * @param ctx Passed to send
+ * @return Number of Responses sent
+ */
+uint32_t rip_db_send_update(const rip_db_t *db, uint32_t interface_index, bool changed_only,
+                            rip_db_send_cb_t send, void *ctx) {
+    rip_db_rte_t rtes[RIP_DB_MAX_RTES];
+    uint32_t count = 0;
+    uint32_t sent = 0;
+
+    if (!db || !send) {
+        return 0;
+    }
+
+    /* Walk the changed list, or every hash chain for a full update */
+    uint32_t chains = changed_only ? 1 : db->bucket_mask + 1;
+    for (uint32_t i = 0; i < chains; i++) {
+        const rip_db_route_t *route = changed_only ? db->changed : db->buckets[i];
+
+        for (; route; route = changed_only ? route->changed_next : route->hash_next) {
+            if (route->interface_index == interface_index) {
+                continue;
+            }
+
+            rtes[count].destination = route->destination;
+            rtes[count].mask = route->mask;
+            rtes[count].next_hop = route->next_hop;
+            rtes[count].metric = route->metric;
+            if (++count == RIP_DB_MAX_RTES) {
+                if (send(interface_index, rtes, count, ctx) != STATUS_SUCCESS) {
+                    return sent;
+                }
+                sent++;
+                count = 0;
+            }
+        }
+    }
+
+    if (count > 0 && send(interface_index, rtes, count, ctx) == STATUS_SUCCESS) {
+        sent++;
+    }
+    return sent;
+}
+
+/**
+ * @brief Record that an update went out on every interface
+ *
+ * @param db Database
+ * @param now Current time, seconds
+ */
+void rip_db_updates_sent(rip_db_t *db, uint32_t now) {
+    if (!db) {
+        return;
+    }
+
+    while (db->changed) {
+        rip_db_route_t *route = db->changed;
+        db->changed = route->changed_next;
+        route->changed_next = NULL;
+        route->changed = false;
+    }
+
+    /* xorshift32; the hold-off only has to differ between routers */
+    uint32_t x = db->rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    db->rand_state = x;
+    db->holdoff_end = now + RIP_DB_TRIGGER_MIN + x % (RIP_DB_TRIGGER_MAX - RIP_DB_TRIGGER_MIN + 1);
+}
+
+/**
+ * @brief Number of routes, the ones under garbage collection included
+ *
+ * @param db Database
+ * @return Route count
+ */
+uint32_t rip_db_count(const rip_db_t *db) {
+    return db ? db->count : 0;
+}
+
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/**
+ * @brief Hash a destination and mask
+ */
+static uint32_t rip_db_hash(uint32_t destination, uint32_t mask) {
+    uint64_t key = ((uint64_t)destination << 32) | mask;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (uint32_t)key;
+}
+
+/**
+ * @brief Find the chain link that holds, or would hold, a route
+ *
+ * @return Pointer to the link; *link is NULL if the route is not known
+ */
+static rip_db_route_t **rip_db_slot(const rip_db_t *db, uint32_t destination, uint32_t mask) {
+    rip_db_route_t **link = &db->buckets[rip_db_hash(destination, mask) & db->bucket_mask];
+    while (*link && ((*link)->destination != destination || (*link)->mask != mask)) {
+        link = &(*link)->hash_next;
+    }
+    return link;
+}
+
+/**
+ * @brief Double the hash table
+ *
+ * @return false if out of memory; the table keeps working, only slower
+ */
+static bool rip_db_grow(rip_db_t *db) {
+    uint32_t size = (db->bucket_mask + 1) * 2;
+    rip_db_route_t **buckets = calloc(size, sizeof(*buckets));
+    if (!buckets) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i <= db->bucket_mask; i++) {
+        rip_db_route_t *route = db->buckets[i];
+        while (route) {
+            rip_db_route_t *next = route->hash_next;
+            uint32_t b = rip_db_hash(route->destination, route->mask) & (size - 1);
+            route->hash_next = buckets[b];
+            buckets[b] = route;
+            route = next;
+        }
+    }
+
+    free(db->buckets);
+    db->buckets = buckets;
+    db->bucket_mask = size - 1;
+    return true;
+}
+
+/**
+ * @brief Push a route at the head of a wheel list
+ */
+static void rip_db_link(rip_db_route_t **head, rip_db_route_t *route) {
+    route->wheel_prev = NULL;
+    route->wheel_next = *head;
+    if (*head) {
+        (*head)->wheel_prev = route;
+    }
+    *head = route;
+}
+
+/**
+ * @brief Take a route out of whichever wheel list holds it
+ */
+static void rip_db_unlink(rip_db_t *db, rip_db_route_t *route) {
+    rip_db_route_t **head;
+
+    if (route->wheel_state == RIP_DB_WHEEL_QUEUED) {
+        head = &db->wheel[route->deadline & RIP_DB_WHEEL_MASK];
+    } else if (route->wheel_state == RIP_DB_WHEEL_HELD) {
+        head = &db->held;
+    } else {
+        return;
+    }
+
+    if (route->wheel_prev) {
+        route->wheel_prev->wheel_next = route->wheel_next;
+    } else {
+        *head = route->wheel_next;
+    }
+    if (route->wheel_next) {
+        route->wheel_next->wheel_prev = route->wheel_prev;
+    }
+    route->wheel_prev = route->wheel_next = NULL;
+    route->wheel_state = 0;
+}
+
+/**
+ * @brief Queue a route for its next deadline
+ *
+ * Deadlines already behind the wheel are moved to the next second expired.
+ */
+static void rip_db_schedule(rip_db_t *db, rip_db_route_t *route, uint32_t deadline) {
+    rip_db_unlink(db, route);
+    if (rip_db_due(deadline, db->next_tick - 1)) {
+        deadline = db->next_tick;
+    }
+    route->deadline = deadline;
+    rip_db_link(&db->wheel[deadline & RIP_DB_WHEEL_MASK], route);
+    route->wheel_state = RIP_DB_WHEEL_QUEUED;
+}
+
+/**
+ * @brief Add a route to the next triggered update, once
+ */
+static void rip_db_mark_changed(rip_db_t *db, rip_db_route_t *route) {
+    if (route->changed) {
+        return;
+    }
+    route->changed = true;
+    route->changed_next = db->changed;
+    db->changed = route;
+}
+
+/**
+ * @brief Unhash and free a route that is on no wheel list
+ */
+static void rip_db_delete(rip_db_t *db, rip_db_route_t *route) {
+    rip_db_route_t **link = rip_db_slot(db, route->destination, route->mask);
+    *link = route->hash_next;
+
+    /* Deleted routes were withdrawn long ago, the list is normally short */
+    if (route->changed) {
+        link = &db->changed;
+        while (*link != route) {
+            link = &(*link)->changed_next;
+        }
+        *link = route->changed_next;
+    }
+
+    db->count--;
+    free(route);
+}
+
+/**
+ * @brief Check whether a second has come, with wrap-around
+ */
+static bool rip_db_due(uint32_t deadline, uint32_t now) {
+    return (int32_t)(deadline - now) <= 0;
+}
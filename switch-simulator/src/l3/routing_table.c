@@ -4,67 +4,408 @@
  *
  * This file contains the implementation of routing table operations for the
  * switch simulator, including route insertion, deletion, lookup, and management.
+ *
+ * Routes are kept in two layers. The RIB holds every candidate route, grouped
+ * by prefix and ordered by administrative distance and metric, in entries
+ * carved from a growable arena. The FIB holds only the best candidate of each
+ * prefix, and its equal-cost peers, as a next-hop group index in a multibit
+ * trie per address family, and is what lookups consult. Groups spread flows
+ * over their paths by 5-tuple hash through resilient buckets.
+ *
+ * Writers serialize on the routing lock. Lookups take no lock: they walk the
+ * FIB inside an RCU read section, and writers only ever change what readers
+ * can reach with single aligned stores. Trie nodes, groups, next hops and RIB
+ * entries that writers free are reused only after a grace period, and arrays
+ * that grow are copied and the old copy retired, so a reader always sees a
+ * consistent, if possibly slightly old, forwarding state.
+ *
+ * Every VRF has tries of its own, so a VRF lookup costs what a single-table
+ * lookup did; the RIB, next hops and groups are shared by all of them. A
+ * route leaked into a VRF is a least preferred candidate there whose FIB
+ * leaves name the route installed in the source VRF, so both forward through
+ * the same objects until the VRF installs a route of its own for the prefix.
+ *
+ * Changes of installed routes reach hardware through a queue that a
+ * programming thread drains in batches, so writers never wait on hardware.
+ * Operations queued for the same prefix fold into one write, or none if
+ * they cancel out; prefixes are programmed in the order first queued.
  */
 
+#define _GNU_SOURCE
+
 #include "l3/routing_table.h"
 #include "common/logging.h"
 #include "common/error_codes.h"
 #include "hal/hw_resources.h"
+#include "common/rcu.h"
+#include "common/threading.h"
+#include "common/config.h"
+#include "common/keyed_hash.h"
+#include "common/mem_arena.h"
+#include "common/mem_account.h"
+#include "common/trace.h"
+#include "common/event_feed.h"
+#include "hal/link_event.h"
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <time.h>
 #include <arpa/inet.h>
 
 /* Defines */
-#define MAX_ROUTES 1024
-#define ROUTE_HASH_SIZE 256
+#define ROUTE_HASH_INITIAL_SIZE 256         /* Prefix buckets, doubled as the RIB grows */
+#define ROUTE_ARENA_CHUNK 4096              /* RIB entries allocated at a time */
+#define ROUTE_CHUNK_DIR_INITIAL 16          /* Chunk directory grows by doubling */
+#define ROUTE_ADMIN_DISTANCE_UNKNOWN 255    /* Least preferred source */
+#define ROUTE_BATCH_DIRTY_INITIAL 1024      /* Batch dirty list, doubled as needed */
+#define ROUTE_BATCH_RETIRED UINT32_MAX      /* Slot of a removed candidate awaiting commit */
+#define ROUTE_MAX_PREFIX_LEN 128
 #define IPV4_ADDR_LEN 4
 #define IPV6_ADDR_LEN 16
 
+/* FIB multibit tries */
+#define LPM_V4_ROOT_BITS 24                 /* DIR-24-8: root read plus at most one node read */
+#define LPM_V6_ROOT_BITS 16                 /* 16 + 14 * 8 = 128 bits */
+#define LPM_STRIDE_BITS 8                   /* Stride of every level below the root */
+#define LPM_NODE_SIZE (1U << LPM_STRIDE_BITS)
+#define LPM_MAX_LEVELS 15                   /* Levels of the IPv6 trie */
+#define LPM_NODE_ALIGN 64                   /* Nodes start on a cache line */
+#define LPM_INITIAL_NODES 64                /* Node array grows by doubling */
+#define LPM_NODE_BYTES(count) ((size_t)(count) * LPM_NODE_SIZE * sizeof(uint32_t))
+#define FIB_ARENA "fib"                     /* Memory arena of the tries and RIB chunks */
+#define LPM_ENTRY_EXT 0x80000000U           /* Entry refers to a child node */
+#define LPM_NODE_MASK 0x7FFFFFFFU           /* Child node number */
+#define LPM_DEPTH_SHIFT 23                  /* Leaf: prefix length of its route */
+#define LPM_DEPTH_MASK 0xFFU
+#define LPM_ROUTE_MASK 0x007FFFFFU          /* Leaf: index of the installed RIB entry */
+#define LPM_LEAF_NONE 0                     /* No route */
+#define LPM_DEPTH_FOLDED LPM_DEPTH_MASK     /* Leaf: stands for a folded node */
+#define LPM_NODE_ROOT UINT32_MAX            /* Node number of the root table */
+
+/* FIB next hops */
+#define NEXTHOP_HASH_SIZE 1024
+#define NEXTHOP_INITIAL_CAPACITY 64         /* Next-hop array grows by doubling */
+
+/* FIB next-hop groups */
+#define NHGROUP_MAX_PATHS 16                /* Equal-cost paths per group */
+#define NHGROUP_BUCKETS 64                  /* Resilient hash buckets per group */
+#define NHGROUP_SLOT_NONE 0xFF              /* Bucket with no reachable path */
+#define NHGROUP_SLOT_BACKUP 0xFE            /* Bucket served by the group's backup */
+#define NHGROUP_HASH_SIZE 1024
+#define NHGROUP_INITIAL_CAPACITY 64         /* Group array grows by doubling */
+
+/* VRFs */
+#define ROUTE_VRF_NONE UINT16_MAX           /* Leak source of a candidate that is not leaked */
+
+/* Lock-free readers */
+#define FIB_RECLAIM_BATCH 256               /* Freed objects of a pool worth a grace period */
+
+/* Lookup result caches */
+#define ROUTE_CACHE_BITS 12                 /* Slots of each worker's cache, as a power of two */
+#define ROUTE_CACHE_SIZE (1U << ROUTE_CACHE_BITS)
+#define ROUTE_CACHE_MAX_WORKERS (CONFIG_MAX_WORKER_THREADS + 4)
+#define ROUTE_CACHE_ALIGN 64
+
+/* Hardware programming queue */
+#define HW_SYNC_HASH_SLOTS (2U * CONFIG_ROUTE_HW_QUEUE_SIZE)   /* Prefix hash of the filling buffer */
+#define HW_SYNC_NS_PER_SEC 1000000000ULL
+#define HW_SYNC_NS_PER_MS 1000000ULL
+#define HW_SYNC_MISSING_BUCKETS 1024U                          /* Refused prefixes, by hash */
+
+#if (CONFIG_ROUTE_HW_QUEUE_SIZE & (CONFIG_ROUTE_HW_QUEUE_SIZE - 1)) != 0
+#error "CONFIG_ROUTE_HW_QUEUE_SIZE must be a power of two"
+#endif
+
+#define ROUTING_LOCK() spinlock_acquire(&g_routing_table.lock)
+#define ROUTING_UNLOCK() spinlock_release(&g_routing_table.lock)
+
 /* Private data types */
-typedef struct route_entry {
-    routing_entry_t info;
-    struct route_entry *next;       /* For hash collision resolution */
-    struct route_entry *lpm_left;   /* For LPM tree traversal - left child */
-    struct route_entry *lpm_right;  /* For LPM tree traversal - right child */
-} route_entry_t;
+
+/* Route as the RIB keeps it; route_entry_t is only the exported lookup result */
+typedef struct {
+    ip_addr_t prefix;               /* Network address, host bits clear */
+    ip_addr_t next_hop;             /* Next hop address */
+    ip_addr_type_t addr_type;       /* Address family of both */
+    uint8_t prefix_len;             /* Prefix length */
+    uint16_t interface_index;       /* Outgoing interface */
+    uint16_t metric;                /* Preference within a source, lower wins */
+    route_source_t source;          /* Source, sets the administrative distance */
+} rib_route_t;
+
+/* Hardware operations queued for a prefix */
+typedef enum {
+    HW_OPERATION_ADD,
+    HW_OPERATION_DELETE
+} hw_operation_t;
+
+/* RIB candidate route; info is immutable while the entry is in use */
+typedef struct rib_entry {
+    rib_route_t info;
+    uint8_t admin_distance;         /* Preference between sources, lower wins */
+    bool stale;                     /* Restored by a warm restart, not yet refreshed by its source */
+    uint16_t vrf_id;                /* VRF whose RIB holds it */
+    uint16_t leak_vrf;              /* VRF a leaked candidate forwards through, or ROUTE_VRF_NONE */
+    uint32_t group_index;           /* FIB next-hop group while installed; for a leak, the
+                                       index of the source route it is installed through */
+    uint32_t index;                 /* Position in the arena + 1, named by FIB leaves */
+    struct rib_entry *next;         /* Next prefix in the hash chain, or next free entry */
+    struct rib_entry *alt;          /* Next less preferred candidate for the same prefix */
+    struct rib_entry *leak_next;    /* Next leaked candidate of any VRF */
+    uint32_t batch_slot;            /* Position in the batch dirty list + 1, 0 if not listed */
+    uint32_t backup_nh;             /* Loop-free alternate its source offered, a next-hop
+                                       reference, 0 if none */
+} rib_entry_t;
+
+/* Block of RIB entries; entries never move once handed out */
+typedef struct rib_chunk {
+    rib_entry_t entries[ROUTE_ARENA_CHUNK];
+} rib_chunk_t;
+
+/* Array replaced by a larger copy, freed once no reader can still hold it */
+typedef struct {
+    rcu_head_t rcu;
+    void *mem;
+    size_t arena_size;              /* Bytes in the FIB arena, 0 for heap memory */
+} fib_retired_array_t;
+
+/* Multibit trie of one address family */
+typedef struct {
+    uint32_t *root;                 /* Indexed by the top root_bits of the address */
+    uint32_t *nodes;                /* Child nodes, one 8-bit stride each */
+    uint8_t root_bits;              /* Stride of the root table */
+    uint32_t node_capacity;         /* Number of allocated nodes */
+    uint32_t node_next;             /* First node never handed out */
+    uint32_t node_count;            /* Number of nodes in use */
+    uint32_t free_head;             /* First freed node + 1, 0 if none */
+    uint32_t *limbo;                /* Freed nodes readers may still be walking */
+    uint32_t limbo_count;
+    uint32_t limbo_capacity;
+    uint32_t folded_count;          /* Nodes folded by FIB compression */
+} lpm_trie_t;
+
+/* FIB of one VRF */
+typedef struct {
+    lpm_trie_t v4;                  /* IPv4 best routes */
+    lpm_trie_t v6;                  /* IPv6 best routes */
+    uint32_t route_count;           /* Candidate routes of the VRF in the RIB */
+} fib_vrf_t;
+
+/* Lookup result, valid for as long as the FIB generation it was found in */
+typedef struct {
+    ip_addr_t addr;                 /* Destination looked up */
+    const rib_entry_t *entry;       /* Installed route it matched, NULL if none */
+    uint32_t generation;            /* FIB generation of the result, 0 if the slot is empty */
+    uint16_t vrf_id;
+    uint8_t type;
+} route_cache_slot_t;
+
+/* Direct-mapped lookup cache of one worker thread, written only by it */
+typedef struct {
+    route_cache_slot_t slots[ROUTE_CACHE_SIZE];
+    uint64_t hits;
+    uint64_t misses;
+} route_cache_t;
+
+/* FIB next hop shared by every prefix forwarded the same way */
+typedef struct {
+    ip_addr_t next_hop;
+    ip_addr_type_t type;
+    uint16_t interface_index;
+    bool up;                        /* Reachable; groups skip it when down */
+    bool link_down;                 /* Its interface's port is down, which also takes it out */
+    uint32_t refcount;              /* Groups and candidates' backups using it, 0 if free */
+    uint32_t chain;                 /* Next in the hash chain or free list + 1, 0 if last */
+} fib_nexthop_t;
+
+/* FIB next-hop group shared by every prefix with the same set of paths */
+typedef struct {
+    uint32_t members[NHGROUP_MAX_PATHS];    /* Next-hop indices, sorted */
+    uint8_t member_count;
+    uint8_t buckets[NHGROUP_BUCKETS];       /* Member slot serving each flow bucket */
+    uint32_t backup;                        /* Next hop taking every flow while all members
+                                               are down, 0 if none */
+    uint32_t refcount;                      /* Installed prefixes using it, 0 if free */
+    uint32_t chain;                         /* Next in the hash chain or free list + 1, 0 if last */
+} fib_nhgroup_t;
 
 /* Routing table structure */
 typedef struct {
-    route_entry_t *hash_table[ROUTE_HASH_SIZE];  /* Hash table for O(1) exact lookup */
-    route_entry_t *lpm_root_v4;                  /* Root of IPv4 LPM tree */
-    route_entry_t *lpm_root_v6;                  /* Root of IPv6 LPM tree */
-    route_entry_t *route_pool;                   /* Pre-allocated route entries */
-    uint16_t route_count;                        /* Number of routes in the table */
+    spinlock_t lock;                             /* Serializes writers; readers never take it */
+
+    /* RIB */
+    rib_entry_t **hash_table;                    /* Best candidate of each prefix, by prefix */
+    uint32_t hash_size;                          /* Number of buckets, a power of two */
+    rib_chunk_t **chunks;                        /* Arena backing every RIB entry, by index */
+    uint32_t chunk_count;
+    uint32_t chunk_capacity;
+    rib_entry_t *free_entries;                   /* Unused RIB entries */
+    rib_entry_t *limbo_entries;                  /* Freed entries readers may still copy */
+    uint32_t limbo_entry_count;
+    uint32_t capacity;                           /* RIB entries allocated */
+    uint32_t route_count;                        /* Candidate routes in the RIB */
+    uint32_t prefix_count;                       /* Distinct prefixes in the RIB */
+    uint32_t ipv4_count;                         /* IPv4 candidate routes */
+    uint32_t ipv6_count;                         /* IPv6 candidate routes */
+    rib_entry_t *leaks;                          /* Leaked candidates of every VRF */
+
+    /* FIB */
+    fib_vrf_t *vrfs[ROUTING_MAX_VRFS];           /* FIB of each VRF, NULL if not created */
+    uint16_t interface_vrf[ROUTING_MAX_INTERFACES]; /* VRF of each ingress router interface */
+    fib_nexthop_t *nexthops;                     /* Next hops by index - 1 */
+    uint32_t nexthop_capacity;                   /* Next hops allocated */
+    uint32_t nexthop_next;                       /* First next hop never handed out */
+    uint32_t nexthop_count;                      /* Next hops in use */
+    uint32_t nexthop_free;                       /* First freed next hop + 1, 0 if none */
+    uint32_t nexthop_limbo;                      /* Freed next hops awaiting a grace period */
+    uint32_t nexthop_limbo_count;
+    uint32_t nexthop_hash[NEXTHOP_HASH_SIZE];    /* First next hop of each bucket + 1 */
+    uint64_t nexthop_link_changes;               /* Next hops switched by port link events */
+    fib_nhgroup_t *groups;                       /* Next-hop groups by index - 1 */
+    uint32_t group_capacity;                     /* Groups allocated */
+    uint32_t group_next;                         /* First group never handed out */
+    uint32_t group_count;                        /* Groups in use */
+    uint32_t group_free;                         /* First freed group + 1, 0 if none */
+    uint32_t group_limbo;                        /* Freed groups awaiting a grace period */
+    uint32_t group_limbo_count;
+    uint32_t group_hash[NHGROUP_HASH_SIZE];      /* First group of each bucket + 1 */
+
+    /* Lookup result caches */
+    uint32_t fib_generation;                     /* Bumped after every FIB change */
+    bool lookup_cache_enabled;                   /* Lookups go through the worker caches */
+    route_cache_t *caches[ROUTE_CACHE_MAX_WORKERS]; /* Cache of each worker that looked up */
+    uint32_t cache_count;                        /* Caches published to the stats reader */
+
+    /* Batched updates */
+    bool batch_active;                           /* FIB and hardware updates wait for commit */
+    rib_entry_t **batch_dirty;                   /* Candidates whose prefix changed */
+    uint32_t batch_dirty_count;
+    uint32_t batch_dirty_capacity;
+
+    /* Warm restart */
+    bool restoring;                              /* Routes being added are restored, stale ones */
+    uint32_t stale_count;                        /* Stale candidates in the RIB */
+
     bool hw_sync_enabled;                        /* Flag indicating if HW sync is enabled */
-} routing_table_t;
+} rib_t;
+
+/* Hardware state of one prefix, as the operations queued for it leave it */
+typedef struct {
+    rib_route_t route;              /* Route of the latest operation */
+    uint32_t hash;
+    bool present_before;                /* Hardware held the prefix before the first operation */
+    bool present_after;                 /* Hardware holds the prefix after the last operation */
+} hw_sync_op_t;
+
+/* Installed prefix the hardware route table had no room for */
+typedef struct hw_sync_missing {
+    rib_route_t route;
+    uint32_t hash;
+    struct hw_sync_missing *next;
+} hw_sync_missing_t;
+
+/* Hardware programming queue; writers fill one buffer while the thread programs the other */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;                /* To the thread: a batch filled up, a flush or a stop */
+    pthread_cond_t done;                /* From the thread: a buffer was taken or programmed */
+    pthread_t thread;
+    bool running;
+    bool busy;                          /* Thread is programming the taken buffer */
+    uint32_t flush_waiters;             /* Flushes waiting for the queue to drain */
+    hw_sync_op_t *ops[2];               /* Prefixes in the order they were first queued */
+    uint32_t count[2];
+    uint32_t filling;                   /* Buffer writers append to */
+    uint64_t *slots;                    /* generation << 32 | op + 1, stale once the buffer is taken */
+    uint32_t generation;
+    hw_sync_missing_t **missing;        /* Refused prefixes; only the thread touches these */
+    uint32_t missing_count;
+
+    /* Statistics */
+    uint64_t queued;
+    uint64_t merged;
+    uint64_t cancelled;
+    uint64_t programmed;
+    uint64_t failed;
+    uint64_t stalls;
+    uint64_t batches;
+    uint64_t batch_last_ns;
+    uint64_t batch_max_ns;
+    uint64_t batch_total_ns;
+} hw_sync_queue_t;
 
 /* Global variables */
-static routing_table_t g_routing_table;
+static rib_t g_routing_table;
+static routing_table_t g_routing_summary;
 static bool g_routing_initialized = false;
+static uint32_t g_route_cache_epoch;            /* Bumped on teardown to orphan thread caches */
+static hw_sync_queue_t g_hw_sync;
+
+/* Lookup cache of the calling thread and the epoch it belongs to */
+static __thread route_cache_t *t_route_cache;
+static __thread uint32_t t_route_cache_epoch;
 
 /* Forward declarations of private functions */
 
 /* --- UTILITY FUNCTIONS ---------------------------------------------------- */
 static uint32_t hash_ipv4_prefix(const ipv4_addr_t *prefix, uint8_t prefix_len);
 static uint32_t hash_ipv6_prefix(const ipv6_addr_t *prefix, uint8_t prefix_len);
-static bool get_bit_from_prefix(const ip_addr_t *prefix, uint8_t bit_pos, ip_addr_type_t type);
-static uint8_t get_common_prefix_len(const ip_addr_t *addr1, const ip_addr_t *addr2, ip_addr_type_t type);
-static bool prefix_match(const ip_addr_t *addr, const ip_addr_t *prefix, uint8_t prefix_len, ip_addr_type_t type);
+static const char *route_addr_str(const ip_addr_t *addr, ip_addr_type_t type);
+static status_t route_entry_to_rib(const route_entry_t *entry, rib_route_t *route);
+static void route_entry_from_rib(const rib_route_t *route, route_entry_t *entry);
 
 /* --- MEMORY MANAGEMENT ---------------------------------------------------- */
-static route_entry_t *allocate_route_entry(void);
-static void free_route_entry(route_entry_t *entry);
+static status_t rib_init(void);
+static void rib_deinit(void);
+static rib_entry_t *allocate_route_entry(void);
+static void free_route_entry(rib_entry_t *entry);
 
 /* --- ROUTE SEARCH AND LOOKUP ---------------------------------------------- */
-static route_entry_t *find_route_exact(const ip_addr_t *prefix, uint8_t prefix_len, ip_addr_type_t type);
-static route_entry_t *find_route_lpm(const ip_addr_t *addr, ip_addr_type_t type);
-
-/* --- LPM TREE OPERATIONS -------------------------------------------------- */
-static void insert_to_lpm_tree(route_entry_t *entry);
-static void remove_from_lpm_tree(route_entry_t *entry);
+static rib_entry_t *find_route_exact(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t prefix_len,
+                                     ip_addr_type_t type);
+static const rib_entry_t *find_route_lpm(uint16_t vrf_id, const ip_addr_t *addr, ip_addr_type_t type);
+static const rib_entry_t *fib_lookup_cached(uint16_t vrf_id, const ip_addr_t *addr, ip_addr_type_t type);
+static uint32_t fib_lookup_group(uint16_t vrf_id, const ip_addr_t *addr, ip_addr_type_t type);
+
+/* --- RIB OPERATIONS ------------------------------------------------------- */
+static status_t rib_add_route(uint16_t vrf_id, const rib_route_t *route, uint16_t leak_vrf);
+static status_t rib_remove_route(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t prefix_len,
+                                 ip_addr_type_t type, const route_source_t *source, uint16_t leak_vrf,
+                                 bool stale_only);
+static status_t rib_add_route_list(const routing_route_t *routes, uint32_t count, uint32_t *added);
+static status_t rib_commit_prefix(rib_entry_t *head, rib_entry_t *installed);
+static status_t rib_commit_batch(void);
+static void rib_flush(void);
+static inline bool route_preferred(const rib_entry_t *a, const rib_entry_t *b);
+static uint8_t route_admin_distance(route_source_t source);
+
+/* --- FIB OPERATIONS ------------------------------------------------------- */
+static status_t fib_init(void);
+static void fib_deinit(void);
+static void fib_flush(void);
+static void fib_withdraw(rib_entry_t *best);
+static void fib_get_memory_stats(routing_table_stats_t *stats);
+static void fib_free_caches(void);
+static void fib_get_cache_stats(routing_table_stats_t *stats);
+static status_t fib_vrf_create(uint16_t vrf_id);
+static void fib_vrf_destroy(uint16_t vrf_id);
+static void fib_reclaim(void);
+static status_t nexthop_get(const rib_route_t *route, uint32_t *nh_index);
+static void nexthop_put(uint32_t nh_index);
+static void fib_link_batch(const link_event_batch_t *batch, void *arg);
+static void fib_retire_array(void *mem, size_t arena_size);
+static uint32_t lpm_trie_lookup(const lpm_trie_t *trie, const uint8_t *addr);
+static void lpm_trie_lookup_bulk(const lpm_trie_t *trie, const uint8_t *const *addrs, uint32_t n,
+                                 uint32_t *leaves);
 
 /* --- HARDWARE SYNCHRONIZATION --------------------------------------------- */
-static void sync_route_to_hw(const route_entry_t *entry, hw_operation_t operation);
+static void sync_route_to_hw(const rib_entry_t *entry, hw_operation_t operation);
+static status_t hw_sync_init(void);
+static void hw_sync_deinit(void);
+static void *hw_sync_thread(void *arg);
+static void hw_sync_program(hw_sync_op_t *ops, uint32_t count, uint32_t *written,
+                            uint32_t *cancelled, uint32_t *failed);
+static void hw_sync_get_stats(routing_table_stats_t *stats);
 
 ///* API для получения экземпляра таблицы маршрутизации */
 //routing_table_t *routing_table_get_instance(void) {
@@ -89,34 +430,58 @@ static void sync_route_to_hw(const route_entry_t *entry, hw_operation_t operatio
  */
 routing_table_t *routing_table_get_instance(void) {
     if (!g_routing_initialized) {
-        if (routing_table_init() != STATUS_SUCCESS) {
-            LOG_ERROR("Failed to initialize routing table");
+        if (routing_table_init(&g_routing_summary) != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_L3, "Failed to initialize routing table");
             return NULL;
         }
     }
-    return &g_routing_table;
+    return &g_routing_summary;
 }
 
 /**
  * @brief Initialize the routing table
  *
+ * The routes live in the module; the caller's table is only cleared.
+ *
+ * @param table Routing table summary to initialize
  * @return STATUS_SUCCESS if successful, error code otherwise
  */
-status_t routing_table_init(void) {
-    LOG_INFO("Initializing routing table module");
+status_t routing_table_init(routing_table_t *table) {
+    if (table == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameter: table pointer is NULL");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    LOG_INFO(LOG_CATEGORY_L3, "Initializing routing table module");
 
     if (g_routing_initialized) {
-        LOG_WARN("Routing table already initialized");
+        LOG_WARNING(LOG_CATEGORY_L3, "Routing table already initialized");
         return STATUS_ALREADY_INITIALIZED;
     }
 
     /* Clear the routing table structure */
     memset(&g_routing_table, 0, sizeof(g_routing_table));
+    memset(&g_routing_summary, 0, sizeof(g_routing_summary));
+    memset(table, 0, sizeof(*table));
+    spinlock_init(&g_routing_table.lock);
+    keyed_hash_init();
+
+    /* Allocate the RIB hash table and the FIB tries; RIB entries come on demand */
+    if (rib_init() != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to allocate memory for routing table entries");
+        return STATUS_NO_MEMORY;
+    }
+
+    if (fib_init() != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to allocate memory for forwarding tables");
+        rib_deinit();
+        return STATUS_NO_MEMORY;
+    }
 
-    /* Pre-allocate route entries */
-    g_routing_table.route_pool = (route_entry_t *)calloc(MAX_ROUTES, sizeof(route_entry_t));
-    if (!g_routing_table.route_pool) {
-        LOG_ERROR("Failed to allocate memory for routing table entries");
+    if (hw_sync_init() != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to start hardware programming queue");
+        fib_deinit();
+        rib_deinit();
         return STATUS_NO_MEMORY;
     }
 
@@ -124,7 +489,12 @@ status_t routing_table_init(void) {
     g_routing_table.hw_sync_enabled = true;
 
     g_routing_initialized = true;
-    LOG_INFO("Routing table initialized successfully, capacity: %d entries", MAX_ROUTES);
+
+    /* Next hops out of a port that goes down stop forwarding at once */
+    if (link_event_subscribe(fib_link_batch, NULL) != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_L3, "Routing table not subscribed to link events");
+    }
+    LOG_INFO(LOG_CATEGORY_L3, "Routing table initialized successfully, capacity grows on demand");
 
     return STATUS_SUCCESS;
 }
@@ -169,20 +539,25 @@ status_t routing_table_init(void) {
  * @return STATUS_SUCCESS if successful, error code otherwise
  */
 status_t routing_table_deinit(void) {
-    LOG_INFO("Deinitializing routing table module");
+    LOG_INFO(LOG_CATEGORY_L3, "Deinitializing routing table module");
 
     if (!g_routing_initialized) {
-        LOG_WARN("Routing table not initialized");
+        LOG_WARNING(LOG_CATEGORY_L3, "Routing table not initialized");
         return STATUS_NOT_INITIALIZED;
     }
 
-    /* Free the route pool */
-    free(g_routing_table.route_pool);
-
-    /* Reset the initialized flag */
+    /* Turn new lookups away and wait for the ones in flight */
     g_routing_initialized = false;
+    rcu_synchronize();
+
+    /* Write what is still queued to hardware and stop the programming thread */
+    hw_sync_deinit();
 
-    LOG_INFO("Routing table deinitialized successfully");
+    /* Free the RIB and the FIB */
+    rib_deinit();
+    fib_deinit();
+
+    LOG_INFO(LOG_CATEGORY_L3, "Routing table deinitialized successfully");
 
     return STATUS_SUCCESS;
 }
@@ -190,74 +565,49 @@ status_t routing_table_deinit(void) {
 /**
  * @brief Add a route to the routing table
  *
+ * The route's type is its source; the route becomes a candidate next to
+ * the ones other sources offered for the prefix.
+ *
+ * @param table Routing table summary, from routing_table_get_instance()
  * @param route Pointer to the route information
  * @return STATUS_SUCCESS if successful, error code otherwise
  */
-status_t routing_table_add_route(const routing_entry_t *route) {
-    route_entry_t *entry;
-    uint32_t hash_index;
+status_t routing_table_add_route(routing_table_t *table, const route_entry_t *route) {
+    rib_route_t info;
+    status_t status;
 
     if (!g_routing_initialized) {
-        LOG_ERROR("Routing table not initialized");
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
         return STATUS_NOT_INITIALIZED;
     }
 
-    if (route == NULL) {
-        LOG_ERROR("NULL route pointer provided to routing_table_add_route");
-        return STATUS_INVALID_PARAM;
-    }
-
-    if (g_routing_table.route_count >= MAX_ROUTES) {
-        LOG_ERROR("Routing table is full (%d entries)", MAX_ROUTES);
-        return STATUS_TABLE_FULL;
+    if (table == NULL || route == NULL) {
+        LOG_ERROR(LOG_CATEGORY_L3, "NULL pointer provided to routing_table_add_route");
+        return STATUS_INVALID_PARAMETER;
     }
 
-    /* Check if the route already exists */
-    if (find_route_exact(&route->prefix, route->prefix_len, route->addr_type)) {
-        LOG_WARN("Route already exists");
-        return STATUS_ALREADY_EXISTS;
+    status = route_entry_to_rib(route, &info);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid netmask or prefix length for route");
+        return status;
     }
 
-    /* Allocate a new route entry */
-    entry = allocate_route_entry();
-    if (!entry) {
-        LOG_ERROR("Failed to allocate route entry");
-        return STATUS_NO_MEMORY;
+    /* Add the candidate to the RIB; the FIB follows if it becomes the best one */
+    ROUTING_LOCK();
+    status = rib_add_route(ROUTING_VRF_DEFAULT, &info, ROUTE_VRF_NONE);
+    ROUTING_UNLOCK();
+    if (status == STATUS_ALREADY_EXISTS) {
+        LOG_WARNING(LOG_CATEGORY_L3, "Route already exists");
+        return status;
     }
-
-    /* Copy the route information */
-    memcpy(&entry->info, route, sizeof(routing_entry_t));
-
-    /* Calculate the hash index */
-    if (route->addr_type == IP_ADDR_TYPE_V4) {
-        hash_index = hash_ipv4_prefix(&route->prefix.v4, route->prefix_len) % ROUTE_HASH_SIZE;
-    } else {
-        hash_index = hash_ipv6_prefix(&route->prefix.v6, route->prefix_len) % ROUTE_HASH_SIZE;
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to add route");
+        return status;
     }
 
-    /* Insert into the hash table (at the beginning of the chain) */
-    entry->next = g_routing_table.hash_table[hash_index];
-    g_routing_table.hash_table[hash_index] = entry;
-    
-    /* Insert into the LPM tree */
-    insert_to_lpm_tree(entry);
-    
-    /* Increment the route count */
-    g_routing_table.route_count++;
-    
-    LOG_INFO("Added route to %s/%d via next hop %s (metric %d, interface %d)",
-             (route->addr_type == IP_ADDR_TYPE_V4) ? 
-                 inet_ntoa(*((struct in_addr *)&route->prefix.v4)) : "IPv6",
-             route->prefix_len,
-             (route->addr_type == IP_ADDR_TYPE_V4) ?
-                 inet_ntoa(*((struct in_addr *)&route->next_hop.v4)) : "IPv6",
-             route->metric,
-             route->egress_if);
-
-    /* Synchronize with hardware if enabled */
-    if (g_routing_table.hw_sync_enabled) {
-        sync_route_to_hw(entry, HW_OPERATION_ADD);
-    }   
+    LOG_INFO(LOG_CATEGORY_L3, "Added route to %s/%d via next hop %s (metric %d, interface %d)",
+             route_addr_str(&info.prefix, info.addr_type), info.prefix_len,
+             route_addr_str(&info.next_hop, info.addr_type), info.metric, info.interface_index);
 
     return STATUS_SUCCESS;
 }
@@ -265,78 +615,36 @@ status_t routing_table_add_route(const routing_entry_t *route) {
 /**
  * @brief Delete a route from the routing table
  *
+ * Removes the candidates of every source for the prefix.
+ *
  * @param prefix IP address prefix
  * @param prefix_len Prefix length
  * @param type IP address type (IPv4 or IPv6)
  * @return STATUS_SUCCESS if successful, error code otherwise
  */
 status_t routing_table_delete_route(const ip_addr_t *prefix, uint8_t prefix_len, ip_addr_type_t type) {
-    route_entry_t *entry, *prev;
-    uint32_t hash_index;
+    status_t status;
 
     if (!g_routing_initialized) {
-        LOG_ERROR("Routing table not initialized");
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
         return STATUS_NOT_INITIALIZED;
     }
 
     if (prefix == NULL) {
-        LOG_ERROR("NULL prefix pointer provided to routing_table_delete_route");
-        return STATUS_INVALID_PARAM;
-    }
-
-    /* Calculate the hash index */
-    if (type == IP_ADDR_TYPE_V4) {
-        hash_index = hash_ipv4_prefix(&prefix->v4, prefix_len) % ROUTE_HASH_SIZE;
-    } else {
-        hash_index = hash_ipv6_prefix(&prefix->v6, prefix_len) % ROUTE_HASH_SIZE;
-    }
-
-    /* Find the route in the hash table */
-    prev = NULL;
-    entry = g_routing_table.hash_table[hash_index];
-
-    while (entry) {
-        if (entry->info.addr_type == type &&
-            entry->info.prefix_len == prefix_len &&
-            memcmp(&entry->info.prefix, prefix,
-                  (type == IP_ADDR_TYPE_V4 ? IPV4_ADDR_LEN : IPV6_ADDR_LEN)) == 0) {
-            /* Found the route */
-            break;
-        }
-        prev = entry;
-        entry = entry->next;
-    }
-
-    if (!entry) {
-        LOG_WARN("Route not found");
-        return STATUS_NOT_FOUND;
-    }
-
-    /* Remove from the hash table */
-    if (prev) {
-        prev->next = entry->next;
-    } else {
-        g_routing_table.hash_table[hash_index] = entry->next;
+        LOG_ERROR(LOG_CATEGORY_L3, "NULL prefix pointer provided to routing_table_delete_route");
+        return STATUS_INVALID_PARAMETER;
     }
 
-    /* Remove from the LPM tree */
-    remove_from_lpm_tree(entry);
-
-    LOG_INFO("Deleted route to %s/%d",
-             (type == IP_ADDR_TYPE_V4) ?
-                 inet_ntoa(*((struct in_addr *)&prefix->v4)) : "IPv6",
-             prefix_len);
-
-    /* Synchronize with hardware if enabled */
-    if (g_routing_table.hw_sync_enabled) {
-        sync_route_to_hw(entry, HW_OPERATION_DELETE);
+    /* Remove every candidate for the prefix */
+    ROUTING_LOCK();
+    status = rib_remove_route(ROUTING_VRF_DEFAULT, prefix, prefix_len, type, NULL, ROUTE_VRF_NONE, false);
+    ROUTING_UNLOCK();
+    if (status != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_L3, "Route not found");
+        return status;
     }
 
-    /* Free the route entry */
-    free_route_entry(entry);
-
-    /* Decrement the route count */
-    g_routing_table.route_count--;
+    LOG_INFO(LOG_CATEGORY_L3, "Deleted route to %s/%d", route_addr_str(prefix, type), prefix_len);
 
     return STATUS_SUCCESS;
 }
@@ -395,45 +703,13 @@ status_t routing_table_delete_route(const ip_addr_t *prefix, uint8_t prefix_len,
  * @return STATUS_SUCCESS if successful, error code otherwise
  */
 status_t routing_table_lookup(routing_table_t *routing_table, const ip_addr_t *dest_ip,
-                             ip_addr_type_t type, routing_entry_t *route_info) {
-    route_entry_t *entry;
-
+                             ip_addr_type_t type, route_entry_t *route_info) {
     if (routing_table == NULL) {
-        LOG_ERROR("NULL routing table provided to routing_table_lookup");
-        return STATUS_INVALID_PARAM;
+        LOG_ERROR(LOG_CATEGORY_L3, "NULL routing table provided to routing_table_lookup");
+        return STATUS_INVALID_PARAMETER;
     }
 
-    if (!routing_table->initialized) {
-        LOG_ERROR("Routing table not initialized");
-        return STATUS_NOT_INITIALIZED;
-    }
-
-    if (dest_ip == NULL || route_info == NULL) {
-        LOG_ERROR("NULL pointer provided to routing_table_lookup");
-        return STATUS_INVALID_PARAM;
-    }
-
-    /* Find the longest prefix match */
-    entry = find_route_lpm_in_table(routing_table, dest_ip, type);
-    if (!entry) {
-        LOG_DEBUG("No matching route found for %s",
-                 (type == IP_ADDR_TYPE_V4) ?
-                     inet_ntoa(*((struct in_addr *)&dest_ip->v4)) : "IPv6");
-        return STATUS_NOT_FOUND;
-    }
-
-    /* Copy the route information */
-    memcpy(route_info, &entry->info, sizeof(routing_entry_t));
-
-    LOG_DEBUG("Found route to %s via next hop %s (metric %d, interface %d)",
-             (type == IP_ADDR_TYPE_V4) ?
-                 inet_ntoa(*((struct in_addr *)&dest_ip->v4)) : "IPv6",
-             (type == IP_ADDR_TYPE_V4) ?
-                 inet_ntoa(*((struct in_addr *)&entry->info.next_hop.v4)) : "IPv6",
-             entry->info.metric,
-             entry->info.egress_if);
-
-    return STATUS_SUCCESS;
+    return routing_lookup(dest_ip, type, route_info);
 }
 
 
@@ -449,24 +725,29 @@ status_t routing_table_lookup(routing_table_t *routing_table, const ip_addr_t *d
  */
 status_t routing_table_cleanup(void) {
     if (!g_routing_initialized) {
-        LOG_WARN("Routing table not initialized, nothing to clean up");
+        LOG_WARNING(LOG_CATEGORY_L3, "Routing table not initialized, nothing to clean up");
         return STATUS_NOT_INITIALIZED;
     }
 
-    LOG_INFO("Cleaning up routing table module");
+    LOG_INFO(LOG_CATEGORY_L3, "Cleaning up routing table module");
 
-    /* Free the route pool */
-    if (g_routing_table.route_pool) {
-        free(g_routing_table.route_pool);
-        g_routing_table.route_pool = NULL;
-    }
+    link_event_unsubscribe(fib_link_batch, NULL);
+
+    /* Turn new lookups away and wait for the ones in flight */
+    g_routing_initialized = false;
+    rcu_synchronize();
+
+    /* Write what is still queued to hardware and stop the programming thread */
+    hw_sync_deinit();
+
+    /* Free the RIB and the FIB */
+    rib_deinit();
+    fib_deinit();
 
     /* Reset the routing table structure */
     memset(&g_routing_table, 0, sizeof(g_routing_table));
 
-    g_routing_initialized = false;
-
-    LOG_INFO("Routing table cleanup completed");
+    LOG_INFO(LOG_CATEGORY_L3, "Routing table cleanup completed");
 
     return STATUS_SUCCESS;
 }
@@ -474,23 +755,89 @@ status_t routing_table_cleanup(void) {
 /**
  * @brief Enable or disable hardware synchronization
  *
+ * Operations queued before sync is disabled are still programmed.
+ *
  * @param enable True to enable HW sync, false to disable
  * @return STATUS_SUCCESS if successful, error code otherwise
  */
 status_t routing_table_set_hw_sync(bool enable) {
     if (!g_routing_initialized) {
-        LOG_ERROR("Routing table not initialized");
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
         return STATUS_NOT_INITIALIZED;
     }
 
+    ROUTING_LOCK();
     g_routing_table.hw_sync_enabled = enable;
+    ROUTING_UNLOCK();
 
-    LOG_INFO("Hardware synchronization %s",
+    LOG_INFO(LOG_CATEGORY_L3, "Hardware synchronization %s",
               enable ? "enabled" : "disabled");
 
     return STATUS_SUCCESS;
 }
 
+/**
+ * @brief Wait until every queued hardware operation is programmed
+ *
+ * Must not be called with the routing lock held.
+ *
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+status_t routing_table_hw_sync_flush(void) {
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    pthread_mutex_lock(&g_hw_sync.lock);
+    g_hw_sync.flush_waiters++;
+    pthread_cond_signal(&g_hw_sync.wake);
+    while (g_hw_sync.count[g_hw_sync.filling] != 0 || g_hw_sync.busy) {
+        pthread_cond_wait(&g_hw_sync.done, &g_hw_sync.lock);
+    }
+    g_hw_sync.flush_waiters--;
+    pthread_mutex_unlock(&g_hw_sync.lock);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Enable or disable the per-worker lookup result caches
+ *
+ * Each thread that looks up routes keeps a direct-mapped cache of
+ * destinations it resolved, reused until the FIB next changes. Worth it
+ * when few destinations carry most of the traffic.
+ *
+ * @param enable True to serve lookups through the caches, false to bypass them
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+status_t routing_table_set_lookup_cache(bool enable) {
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    ROUTING_LOCK();
+    __atomic_store_n(&g_routing_table.lookup_cache_enabled, enable, __ATOMIC_RELAXED);
+    ROUTING_UNLOCK();
+
+    LOG_INFO(LOG_CATEGORY_L3, "Route lookup cache %s", enable ? "enabled" : "disabled");
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the FIB generation
+ *
+ * Bumped after every change of an installed route or of a next hop's
+ * state; anything derived from a lookup is current while it stays put.
+ *
+ * @return Current generation
+ */
+uint32_t routing_table_get_generation(void) {
+    return __atomic_load_n(&g_routing_table.fib_generation, __ATOMIC_ACQUIRE);
+}
+
 /**
  * @brief Get routing table statistics
  *
@@ -499,18 +846,26 @@ status_t routing_table_set_hw_sync(bool enable) {
  */
 status_t routing_table_get_stats(routing_table_stats_t *stats) {
     if (!g_routing_initialized) {
-        LOG_ERROR("Routing table not initialized");
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
         return STATUS_NOT_INITIALIZED;
     }
     
     if (stats == NULL) {
-        LOG_ERROR("NULL pointer provided to routing_table_get_stats");
-        return STATUS_INVALID_PARAM;
+        LOG_ERROR(LOG_CATEGORY_L3, "NULL pointer provided to routing_table_get_stats");
+        return STATUS_INVALID_PARAMETER;
     }
     
+    ROUTING_LOCK();
     stats->total_routes = g_routing_table.route_count;
-    stats->max_routes = MAX_ROUTES;
+    stats->ipv4_routes = g_routing_table.ipv4_count;
+    stats->ipv6_routes = g_routing_table.ipv6_count;
+    stats->max_routes = g_routing_table.capacity;
     stats->hw_sync_enabled = g_routing_table.hw_sync_enabled;
+    stats->stale_routes = g_routing_table.stale_count;
+    fib_get_memory_stats(stats);
+    fib_get_cache_stats(stats);
+    hw_sync_get_stats(stats);
+    ROUTING_UNLOCK();
     
     return STATUS_SUCCESS;
 }
@@ -521,41 +876,19 @@ status_t routing_table_get_stats(routing_table_stats_t *stats) {
  * @return STATUS_SUCCESS if successful, error code otherwise
  */
 status_t routing_table_flush(void) {
-    uint32_t i;
-    route_entry_t *entry, *next;
-    
     if (!g_routing_initialized) {
-        LOG_ERROR("Routing table not initialized");
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
         return STATUS_NOT_INITIALIZED;
     }
     
-    LOG_INFO("Flushing routing table (%d entries)", g_routing_table.route_count);
-    
-    /* Iterate through the hash table and free all entries */
-    for (i = 0; i < ROUTE_HASH_SIZE; i++) {
-        entry = g_routing_table.hash_table[i];
-        while (entry) {
-            next = entry->next;
-            
-            /* Synchronize with hardware if enabled */
-            if (g_routing_table.hw_sync_enabled) {
-                sync_route_to_hw(entry, HW_OPERATION_DELETE);
-            }
-            
-            free_route_entry(entry);
-            entry = next;
-        }
-        g_routing_table.hash_table[i] = NULL;
-    }
-    
-    /* Reset the LPM tree roots */
-    g_routing_table.lpm_root_v4 = NULL;
-    g_routing_table.lpm_root_v6 = NULL;
+    ROUTING_LOCK();
+    LOG_INFO(LOG_CATEGORY_L3, "Flushing routing table (%u entries)", g_routing_table.route_count);
     
-    /* Reset the route count */
-    g_routing_table.route_count = 0;
+    /* Withdraw every prefix and return all entries to the arena */
+    rib_flush();
+    ROUTING_UNLOCK();
     
-    LOG_INFO("Routing table flushed successfully");
+    LOG_INFO(LOG_CATEGORY_L3, "Routing table flushed successfully");
     
     return STATUS_SUCCESS;
 }
@@ -573,37 +906,28 @@ status_t routing_table_flush(void) {
  * @return STATUS_SUCCESS if successful, error code otherwise
  */
 status_t routing_get_stats(routing_table_stats_t *stats) {
-    uint16_t i;
-    uint16_t ipv4_count = 0;
-    uint16_t ipv6_count = 0;
-
     if (!g_routing_initialized) {
-        LOG_ERROR("Routing table not initialized");
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
         return STATUS_NOT_INITIALIZED;
     }
 
     if (!stats) {
-        LOG_ERROR("Invalid parameter for routing_get_stats");
-        return STATUS_INVALID_PARAMS;
-    }
-
-    /* Count IPv4 and IPv6 routes */
-    for (i = 0; i < MAX_ROUTES; i++) {
-        if (g_routing_table.route_pool[i].info.prefix_len > 0) {
-            if (g_routing_table.route_pool[i].info.addr_type == IP_ADDR_TYPE_V4) {
-                ipv4_count++;
-            } else {
-                ipv6_count++;
-            }
-        }
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameter for routing_get_stats");
+        return STATUS_INVALID_PARAMETER;
     }
 
     /* Fill in statistics */
+    ROUTING_LOCK();
     stats->total_routes = g_routing_table.route_count;
-    stats->ipv4_routes = ipv4_count;
-    stats->ipv6_routes = ipv6_count;
-    stats->max_routes = MAX_ROUTES;
+    stats->ipv4_routes = g_routing_table.ipv4_count;
+    stats->ipv6_routes = g_routing_table.ipv6_count;
+    stats->max_routes = g_routing_table.capacity;
     stats->hw_sync_enabled = g_routing_table.hw_sync_enabled;
+    stats->stale_routes = g_routing_table.stale_count;
+    fib_get_memory_stats(stats);
+    fib_get_cache_stats(stats);
+    hw_sync_get_stats(stats);
+    ROUTING_UNLOCK();
 
     return STATUS_SUCCESS;
 }
@@ -637,28 +961,16 @@ status_t routing_get_stats(routing_table_stats_t *stats) {
  * @return Hash value
  */
 static uint32_t hash_ipv4_prefix(const ipv4_addr_t *prefix, uint8_t prefix_len) {
-    uint32_t hash;
-    uint32_t addr = prefix->addr;
+    uint32_t addr = *prefix;
     
     /* Apply mask to the address based on prefix length */
     if (prefix_len < 32) {
-        uint32_t mask = 0xFFFFFFFF << (32 - prefix_len);
-        addr &= mask;
+        uint32_t mask = prefix_len ? 0xFFFFFFFF << (32 - prefix_len) : 0;
+        addr &= htonl(mask);
     }
     
-    /* Jenkins hash function */
-    hash = addr;
-    hash = (hash + 0x7ed55d16) + (hash << 12);
-    hash = (hash ^ 0xc761c23c) ^ (hash >> 19);
-    hash = (hash + 0x165667b1) + (hash << 5);
-    hash = (hash + 0xd3a2646c) ^ (hash << 9);
-    hash = (hash + 0xfd7046c5) + (hash << 3);
-    hash = (hash ^ 0xb55a4f09) ^ (hash >> 16);
-    
-    /* Include prefix length in hash */
-    hash ^= prefix_len;
-    
-    return hash;
+    /* Keyed, with the prefix length, so peers cannot aim routes at a bucket */
+    return (uint32_t)keyed_hash_u64((uint64_t)prefix_len << 32 | addr);
 }
 
 /**
@@ -669,8 +981,7 @@ static uint32_t hash_ipv4_prefix(const ipv4_addr_t *prefix, uint8_t prefix_len)
  * @return Hash value
  */
 static uint32_t hash_ipv6_prefix(const ipv6_addr_t *prefix, uint8_t prefix_len) {
-    uint32_t hash = 0;
-    uint8_t i;
+    uint8_t key[17] = { 0 };
     uint8_t bytes_to_hash = (prefix_len + 7) / 8; /* Ceiling of prefix_len / 8 */
     
     /* Use at most 16 bytes */
@@ -678,153 +989,106 @@ static uint32_t hash_ipv6_prefix(const ipv6_addr_t *prefix, uint8_t prefix_len)
         bytes_to_hash = 16;
     }
     
-    /* Apply XOR to all the bytes */
-    for (i = 0; i < bytes_to_hash; i++) {
-        hash ^= ((uint32_t)prefix->addr[i] << ((i % 4) * 8));
-        
-        /* Every 4 bytes, mix the hash */
-        if ((i % 4) == 3 || i == bytes_to_hash - 1) {
-            hash = (hash + 0x7ed55d16) + (hash << 12);
-            hash = (hash ^ 0xc761c23c) ^ (hash >> 19);
-            hash = (hash + 0x165667b1) + (hash << 5);
-            hash = (hash + 0xd3a2646c) ^ (hash << 9);
-            hash = (hash + 0xfd7046c5) + (hash << 3);
-            hash = (hash ^ 0xb55a4f09) ^ (hash >> 16);
-        }
-    }
+    /* The prefix bytes, zero-padded, then the prefix length */
+    memcpy(key, prefix->addr, bytes_to_hash);
+    key[16] = prefix_len;
     
-    /* Include prefix length in hash */
-    hash ^= prefix_len;
-    
-    return hash;
+    return (uint32_t)keyed_hash_bytes(key, sizeof(key));
 }
 
 /**
- * @brief Get a specific bit from an IP prefix
+ * @brief Format an address for logging
  *
- * @param prefix IP address prefix
- * @param bit_pos Bit position (0 is most significant)
+ * Returns one of a few per-thread buffers in turn, so a log call may
+ * format several addresses.
+ *
+ * @param addr IP address
  * @param type IP address type (IPv4 or IPv6)
- * @return The value of the bit (true for 1, false for 0)
+ * @return Address in text form
  */
-static bool get_bit_from_prefix(const ip_addr_t *prefix, uint8_t bit_pos, ip_addr_type_t type) {
-    uint8_t byte_pos;
-    uint8_t bit_in_byte;
-    uint8_t byte_value;
-
-    if (type == IP_ADDR_TYPE_V4) {
-        if (bit_pos >= 32) {
-            return false;  /* Out of range for IPv4 */
-        }
-
-        byte_pos = bit_pos / 8;
-        bit_in_byte = 7 - (bit_pos % 8);  /* Bit 0 is the MSB in the byte */
-
-        byte_value = ((uint8_t *)&prefix->v4)[byte_pos];
-        return (byte_value & (1 << bit_in_byte)) != 0;
-    } else {
-        if (bit_pos >= 128) {
-            return false;  /* Out of range for IPv6 */
-        }
+static const char *route_addr_str(const ip_addr_t *addr, ip_addr_type_t type) {
+    static __thread char bufs[4][INET6_ADDRSTRLEN];
+    static __thread uint8_t next;
+    char *buf = bufs[next++ & 3];
 
-        byte_pos = bit_pos / 8;
-        bit_in_byte = 7 - (bit_pos % 8);  /* Bit 0 is the MSB in the byte */
-
-        byte_value = prefix->v6.addr[byte_pos];
-        return (byte_value & (1 << bit_in_byte)) != 0;
+    if (!inet_ntop((type == IP_TYPE_V4) ? AF_INET : AF_INET6, &addr->addr, buf, INET6_ADDRSTRLEN)) {
+        return "?";
     }
+    return buf;
 }
 
 /**
- * @brief Get the number of common prefix bits between two IP addresses
+ * @brief Convert a route from the exported form to the RIB form
  *
- * @param addr1 First IP address
- * @param addr2 Second IP address
- * @param type IP address type (IPv4 or IPv6)
- * @return Number of common prefix bits
+ * The route's type is its source. An IPv4 netmask must be contiguous.
+ *
+ * @param entry Route in exported form
+ * @param[out] route Route in RIB form
+ * @return STATUS_SUCCESS if successful, STATUS_INVALID_PARAMETER for a bad
+ *         netmask or prefix length
  */
-static uint8_t get_common_prefix_len(const ip_addr_t *addr1, const ip_addr_t *addr2, ip_addr_type_t type) {
-    uint8_t common_bits = 0;
-    uint8_t i, j;
-    uint8_t byte1, byte2;
-    uint8_t max_bytes = (type == IP_ADDR_TYPE_V4) ? IPV4_ADDR_LEN : IPV6_ADDR_LEN;
+static status_t route_entry_to_rib(const route_entry_t *entry, rib_route_t *route) {
+    memset(route, 0, sizeof(*route));
 
-    for (i = 0; i < max_bytes; i++) {
-        if (type == IP_ADDR_TYPE_V4) {
-            byte1 = ((uint8_t *)&addr1->v4)[i];
-            byte2 = ((uint8_t *)&addr2->v4)[i];
-        } else {
-            byte1 = addr1->v6.addr[i];
-            byte2 = addr2->v6.addr[i];
+    if (entry->is_ipv6) {
+        if (entry->route.ipv6.prefix_len > 128) {
+            return STATUS_INVALID_PARAMETER;
         }
+        route->addr_type = IP_TYPE_V6;
+        route->prefix.addr.v6 = entry->route.ipv6.destination;
+        route->next_hop.addr.v6 = entry->route.ipv6.next_hop;
+        route->prefix_len = entry->route.ipv6.prefix_len;
+    } else {
+        uint32_t mask = ntohl(entry->route.ipv4.netmask);
+        uint8_t len = (uint8_t)__builtin_popcount(mask);
 
-        if (byte1 == byte2) {
-            common_bits += 8;
-        } else {
-            /* Find the number of common bits in the differing byte */
-            for (j = 0; j < 8; j++) {
-                if ((byte1 & (0x80 >> j)) == (byte2 & (0x80 >> j))) {
-                    common_bits++;
-                } else {
-                    return common_bits;
-                }
-            }
+        if (mask != (len ? 0xFFFFFFFFU << (32 - len) : 0)) {
+            return STATUS_INVALID_PARAMETER;
         }
+        route->addr_type = IP_TYPE_V4;
+        route->prefix.addr.v4 = entry->route.ipv4.destination;
+        route->next_hop.addr.v4 = entry->route.ipv4.gateway;
+        route->prefix_len = len;
     }
 
-    return common_bits;
+    route->prefix.type = route->addr_type;
+    route->next_hop.type = route->addr_type;
+    route->interface_index = entry->interface_index;
+    route->metric = entry->metric;
+    route->source = entry->type;
+
+    return STATUS_SUCCESS;
 }
 
 /**
- * @brief Check if an address matches a prefix
+ * @brief Convert a route from the RIB form to the exported form
  *
- * @param addr IP address to check
- * @param prefix IP address prefix to match against
- * @param prefix_len Prefix length
- * @param type IP address type (IPv4 or IPv6)
- * @return True if the address matches the prefix, false otherwise
+ * @param route Route in RIB form
+ * @param[out] entry Route in exported form
  */
-static bool prefix_match(const ip_addr_t *addr, const ip_addr_t *prefix, uint8_t prefix_len, ip_addr_type_t type) {
-    uint8_t bytes_to_check;
-    uint8_t bits_in_last_byte;
-    uint8_t i;
-    uint8_t mask;
-    
-    if (type == IP_ADDR_TYPE_V4) {
-        /* Check full bytes */
-        bytes_to_check = prefix_len / 8;
-        if (bytes_to_check > 0 && memcmp(&addr->v4, &prefix->v4, bytes_to_check) != 0) {
-            return false;
-        }
-        
-        /* Check partial byte if needed */
-        bits_in_last_byte = prefix_len % 8;
-        if (bits_in_last_byte > 0) {
-            mask = 0xFF << (8 - bits_in_last_byte);
-            if ((((uint8_t *)&addr->v4)[bytes_to_check] & mask) != 
-                (((uint8_t *)&prefix->v4)[bytes_to_check] & mask)) {
-                return false;
-            }
-        }
+static void route_entry_from_rib(const rib_route_t *route, route_entry_t *entry) {
+    memset(entry, 0, sizeof(*entry));
+
+    entry->is_ipv6 = (route->addr_type == IP_TYPE_V6);
+    if (entry->is_ipv6) {
+        entry->route.ipv6.destination = route->prefix.addr.v6;
+        entry->route.ipv6.prefix_len = route->prefix_len;
+        entry->route.ipv6.next_hop = route->next_hop.addr.v6;
+        entry->next_hop.ipv6 = route->next_hop.addr.v6;
     } else {
-        /* Check full bytes */
-        bytes_to_check = prefix_len / 8;
-        if (bytes_to_check > 0 && memcmp(addr->v6.addr, prefix->v6.addr, bytes_to_check) != 0) {
-            return false;
-        }
-        
-        /* Check partial byte if needed */
-        bits_in_last_byte = prefix_len % 8;
-        if (bits_in_last_byte > 0) {
-            mask = 0xFF << (8 - bits_in_last_byte);
-            if ((addr->v6.addr[bytes_to_check] & mask) !=
-                (prefix->v6.addr[bytes_to_check] & mask)) {
-                return false;
-            }
-        }
+        entry->route.ipv4.destination = route->prefix.addr.v4;
+        entry->route.ipv4.netmask = route->prefix_len ? htonl(0xFFFFFFFFU << (32 - route->prefix_len)) : 0;
+        entry->route.ipv4.gateway = route->next_hop.addr.v4;
+        entry->next_hop.ipv4 = route->next_hop.addr.v4;
     }
 
-    return true;
+    entry->interface_index = route->interface_index;
+    entry->egress_port = route->interface_index;
+    entry->type = (route_type_t)route->source;
+    entry->admin_distance = route_admin_distance(route->source);
+    entry->metric = route->metric;
+    entry->active = true;
+    entry->is_connected = (route->source == ROUTE_TYPE_CONNECTED);
 }
 
 
@@ -834,706 +1098,4962 @@ static bool prefix_match(const ip_addr_t *addr, const ip_addr_t *prefix, uint8_t
 /* --- MEMORY MANAGEMENT ---------------------------------------------------- */
 
 /**
- * @brief Allocate a route entry from the pool
+ * @brief Allocate the RIB hash table with no routes
  *
- * @return Pointer to the allocated entry, NULL if none available
+ * @return STATUS_SUCCESS if successful, STATUS_NO_MEMORY otherwise
  */
-static route_entry_t *allocate_route_entry(void) {
-    uint16_t i;
-    
-    /* Find a free entry in the pool */
-    for (i = 0; i < MAX_ROUTES; i++) {
-        /* Check if the entry is free */
-        if (g_routing_table.route_pool[i].info.addr_type == IP_ADDR_TYPE_INVALID) {
-            /* Clear the entry */
-            memset(&g_routing_table.route_pool[i], 0, sizeof(route_entry_t));
-            return &g_routing_table.route_pool[i];
-        }
+static status_t rib_init(void) {
+    g_routing_table.hash_table = (rib_entry_t **)mem_calloc(MEM_TAG_FIB, ROUTE_HASH_INITIAL_SIZE, sizeof(rib_entry_t *));
+    if (!g_routing_table.hash_table) {
+        return STATUS_NO_MEMORY;
     }
-    
-    /* No free entries available */
-    return NULL;
+
+    g_routing_table.hash_size = ROUTE_HASH_INITIAL_SIZE;
+
+    return STATUS_SUCCESS;
 }
 
 /**
- * @brief Free a route entry back to the pool
+ * @brief Return every RIB entry to the system
  *
- * @param entry Route entry to free
+ * No reader may still hold an entry.
  */
-static void free_route_entry(route_entry_t *entry) {
-    /* Mark the entry as free */
-    entry->info.addr_type = IP_ADDR_TYPE_INVALID;
-    
-    /* Clear the entry */
-    memset(entry, 0, sizeof(route_entry_t));
-}
-
+static void rib_free_arena(void) {
+    uint32_t i;
 
+    for (i = 0; i < g_routing_table.chunk_count; i++) {
+        mem_arena_free(mem_arena_get(FIB_ARENA), g_routing_table.chunks[i], sizeof(rib_chunk_t));
+    }
 
-/* --- ROUTE SEARCH AND LOOKUP ---------------------------------------------- */
+    g_routing_table.chunk_count = 0;
+    g_routing_table.free_entries = NULL;
+    g_routing_table.limbo_entries = NULL;
+    g_routing_table.limbo_entry_count = 0;
+    g_routing_table.batch_dirty_count = 0;
+    g_routing_table.capacity = 0;
+    g_routing_table.route_count = 0;
+    g_routing_table.prefix_count = 0;
+    g_routing_table.ipv4_count = 0;
+    g_routing_table.ipv6_count = 0;
+    g_routing_table.stale_count = 0;
+}
 
 /**
- * @brief Find a route with exact match
- *
- * @param prefix IP address prefix
- * @param prefix_len Prefix length
- * @param type IP address type (IPv4 or IPv6)
- * @return Pointer to the route entry if found, NULL otherwise
+ * @brief Free the RIB hash table and arena
  */
-static route_entry_t *find_route_exact(const ip_addr_t *prefix, uint8_t prefix_len, ip_addr_type_t type) {
-    route_entry_t *entry;
-    uint32_t hash_index;
-    
-    /* Calculate the hash index */
-    if (type == IP_ADDR_TYPE_V4) {
-        hash_index = hash_ipv4_prefix(&prefix->v4, prefix_len) % ROUTE_HASH_SIZE;
-    } else {
-        hash_index = hash_ipv6_prefix(&prefix->v6, prefix_len) % ROUTE_HASH_SIZE;
-    }
-    
-    /* Search in the hash chain */
-    entry = g_routing_table.hash_table[hash_index];
-    while (entry) {
-        if (entry->info.addr_type == type && 
-            entry->info.prefix_len == prefix_len &&
-            memcmp(&entry->info.prefix, prefix, 
-                  (type == IP_ADDR_TYPE_V4 ? IPV4_ADDR_LEN : IPV6_ADDR_LEN)) == 0) {
-            /* Found the route */
-            return entry;
-        }
-        entry = entry->next;
-    }
-    
-    /* Route not found */
-    return NULL;
+static void rib_deinit(void) {
+    rib_free_arena();
+    mem_free(MEM_TAG_FIB, g_routing_table.chunks);
+    g_routing_table.chunks = NULL;
+    g_routing_table.chunk_capacity = 0;
+    mem_free(MEM_TAG_FIB, g_routing_table.hash_table);
+    g_routing_table.hash_table = NULL;
+    g_routing_table.hash_size = 0;
+    mem_free(MEM_TAG_FIB, g_routing_table.batch_dirty);
+    g_routing_table.batch_dirty = NULL;
+    g_routing_table.batch_dirty_capacity = 0;
+    g_routing_table.batch_active = false;
 }
 
 /**
- * @brief Find a route using longest prefix match
+ * @brief Add a chunk of entries to the arena
  *
- * @param addr IP address to match
- * @param type IP address type (IPv4 or IPv6)
- * @return Pointer to the route entry if found, NULL otherwise
+ * Entries are numbered by their position so FIB leaves can name them; the
+ * chunk directory is published before any entry of the chunk can be.
+ *
+ * @return STATUS_SUCCESS if successful, error code otherwise
  */
-static route_entry_t *find_route_lpm(const ip_addr_t *addr, ip_addr_type_t type) {
-    route_entry_t *current;
-    route_entry_t *best_match = NULL;
-    uint8_t bit_pos = 0;
-    bool bit_value;
-    
-    /* Select the appropriate tree based on address type */
-    if (type == IP_ADDR_TYPE_V4) {
-        current = g_routing_table.lpm_root_v4;
-    } else {
-        current = g_routing_table.lpm_root_v6;
+static status_t rib_grow_arena(void) {
+    rib_chunk_t **chunks;
+    rib_chunk_t *chunk;
+    uint32_t capacity;
+    uint32_t base;
+    uint32_t i;
+
+    if ((g_routing_table.chunk_count + 1) * ROUTE_ARENA_CHUNK > LPM_ROUTE_MASK) {
+        return STATUS_TABLE_FULL;
     }
-    
-    /* Traverse the tree */
-    while (current) {
-        /* Check if the current node matches the address */
-        if (prefix_match(addr, &current->info.prefix, current->info.prefix_len, type)) {
-            /* Update the best match if this is a better match */
-            if (best_match == NULL || current->info.prefix_len > best_match->info.prefix_len) {
-                best_match = current;
-            }
+
+    if (g_routing_table.chunk_count == g_routing_table.chunk_capacity) {
+        capacity = g_routing_table.chunk_capacity ? g_routing_table.chunk_capacity * 2 : ROUTE_CHUNK_DIR_INITIAL;
+        chunks = (rib_chunk_t **)mem_calloc(MEM_TAG_FIB, capacity, sizeof(rib_chunk_t *));
+        if (!chunks) {
+            return STATUS_NO_MEMORY;
         }
-        
-        /* Get the bit value at the current position */
-        if (bit_pos < (type == IP_ADDR_TYPE_V4 ? 32 : 128)) {
-            bit_value = get_bit_from_prefix(addr, bit_pos, type);
-            
-            /* Follow the appropriate child */
-            if (bit_value) {
-                current = current->lpm_right;
-            } else {
-                current = current->lpm_left;
-            }
-            
-            bit_pos++;
-        } else {
-            /* Reached the end of the address bits */
-            break;
+
+        if (g_routing_table.chunks) {
+            memcpy(chunks, g_routing_table.chunks, g_routing_table.chunk_count * sizeof(rib_chunk_t *));
+            fib_retire_array(g_routing_table.chunks, 0);
         }
+        __atomic_store_n(&g_routing_table.chunks, chunks, __ATOMIC_RELEASE);
+        g_routing_table.chunk_capacity = capacity;
     }
-    
-    return best_match;
-}
 
+    chunk = (rib_chunk_t *)mem_arena_alloc(mem_arena_get(FIB_ARENA), sizeof(rib_chunk_t), 0);
+    if (!chunk) {
+        return STATUS_NO_MEMORY;
+    }
+
+    /* Hand out the chunk in address order */
+    base = g_routing_table.chunk_count * ROUTE_ARENA_CHUNK;
+    for (i = ROUTE_ARENA_CHUNK; i-- > 0; ) {
+        chunk->entries[i].index = base + i + 1;
+        chunk->entries[i].next = g_routing_table.free_entries;
+        g_routing_table.free_entries = &chunk->entries[i];
+    }
 
+    __atomic_store_n(&g_routing_table.chunks[g_routing_table.chunk_count], chunk, __ATOMIC_RELEASE);
+    g_routing_table.chunk_count++;
+    g_routing_table.capacity += ROUTE_ARENA_CHUNK;
 
-/* --- LPM TREE OPERATIONS -------------------------------------------------- */
+    return STATUS_SUCCESS;
+}
 
 /**
- * @brief Insert a route entry into the LPM tree
+ * @brief Allocate a route entry from the arena
  *
- * @param entry Route entry to insert
+ * The arena grows by ROUTE_ARENA_CHUNK entries when it runs out, so the RIB
+ * has no fixed capacity and entries keep their address for their lifetime.
+ *
+ * @return Pointer to the allocated entry, NULL if out of memory
  */
-static void insert_to_lpm_tree(route_entry_t *entry) {
-    route_entry_t **tree_root;
-    route_entry_t **current;
-    uint8_t bit_pos;
-    bool bit_value;
-    
-    /* Select the appropriate tree based on address type */
-    if (entry->info.addr_type == IP_ADDR_TYPE_V4) {
-        tree_root = &g_routing_table.lpm_root_v4;
-    } else {
-        tree_root = &g_routing_table.lpm_root_v6;
+static rib_entry_t *allocate_route_entry(void) {
+    rib_entry_t *entry;
+    uint32_t index;
+
+    if (!g_routing_table.free_entries && g_routing_table.limbo_entry_count >= FIB_RECLAIM_BATCH) {
+        fib_reclaim();
     }
-    
-    /* Start from the root */
-    current = tree_root;
-    
-    /* Traverse the tree based on prefix bits */
-    for (bit_pos = 0; bit_pos < entry->info.prefix_len; bit_pos++) {
-        if (*current == NULL) {
-            /* Create a new node */
-            *current = entry;
-            return;
+
+    if (!g_routing_table.free_entries && rib_grow_arena() != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "No memory for %d more route entries", ROUTE_ARENA_CHUNK);
+        return NULL;
+    }
+
+    entry = g_routing_table.free_entries;
+    g_routing_table.free_entries = entry->next;
+    index = entry->index;
+    memset(entry, 0, sizeof(rib_entry_t));
+    entry->index = index;
+
+    return entry;
+}
+
+/**
+ * @brief Free a route entry back to the arena
+ *
+ * Readers may still be copying it, so it is reused only after a grace
+ * period.
+ *
+ * @param entry Route entry to free
+ */
+static void free_route_entry(rib_entry_t *entry) {
+    rib_entry_t **leak;
+
+    if (entry->leak_vrf != ROUTE_VRF_NONE) {
+        for (leak = &g_routing_table.leaks; *leak; leak = &(*leak)->leak_next) {
+            if (*leak == entry) {
+                *leak = entry->leak_next;
+                break;
+            }
         }
-        
-        /* Get the bit value at the current position */
-        bit_value = get_bit_from_prefix(&entry->info.prefix, bit_pos, entry->info.addr_type);
-        
-        /* Follow the appropriate child */
-        if (bit_value) {
-            current = &((*current)->lpm_right);
-        } else {
-            current = &((*current)->lpm_left);
+    }
+
+    nexthop_put(entry->backup_nh);
+    entry->backup_nh = 0;
+
+    entry->next = g_routing_table.limbo_entries;
+    g_routing_table.limbo_entries = entry;
+    g_routing_table.limbo_entry_count++;
+}
+
+
+
+/* --- ROUTE SEARCH AND LOOKUP ---------------------------------------------- */
+
+/**
+ * @brief Get the bytes of an address in network order
+ *
+ * @param addr IP address
+ * @param type IP address type (IPv4 or IPv6)
+ * @return First byte of the address
+ */
+static inline const uint8_t *route_addr_bytes(const ip_addr_t *addr, ip_addr_type_t type) {
+    return (type == IP_TYPE_V4) ? (const uint8_t *)&addr->addr.v4 : addr->addr.v6.addr;
+}
+
+/**
+ * @brief Clear the host bits of a prefix
+ *
+ * Stored prefixes are always masked so exact lookups match however the
+ * caller wrote the address.
+ *
+ * @param prefix IP address prefix to mask in place
+ * @param prefix_len Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ */
+static void mask_prefix(ip_addr_t *prefix, uint8_t prefix_len, ip_addr_type_t type) {
+    uint8_t *bytes = (uint8_t *)route_addr_bytes(prefix, type);
+    uint8_t len = (type == IP_TYPE_V4) ? IPV4_ADDR_LEN : IPV6_ADDR_LEN;
+    uint8_t i;
+
+    for (i = 0; i < len; i++) {
+        if (prefix_len >= 8) {
+            prefix_len -= 8;
+            continue;
         }
+        bytes[i] &= (uint8_t)(0xFF << (8 - prefix_len));
+        prefix_len = 0;
     }
-    
-    /* Insert the entry at the current position */
-    *current = entry;
 }
 
 /**
- * @brief Remove a route entry from the LPM tree
+ * @brief Hash a prefix for the RIB hash table
  *
- * @param entry Route entry to remove
+ * @param vrf_id VRF of the prefix
+ * @param prefix IP address prefix
+ * @param prefix_len Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ * @return Hash value, to be reduced to the table size
  */
-static void remove_from_lpm_tree(route_entry_t *entry) {
-    /* For simplicity, we just clear the LPM tree links */
-    entry->lpm_left = NULL;
-    entry->lpm_right = NULL;
-    
-    /* For a real implementation, we would need to rebuild the tree */
-    /* Since this is a simulator, this approach is acceptable */
-    /* In a production system, a more sophisticated data structure would be used */
-    
-    /* Clear the LPM tree roots */
-    g_routing_table.lpm_root_v4 = NULL;
-    g_routing_table.lpm_root_v6 = NULL;
-    
-    /* Rebuild the LPM trees */
+static inline uint32_t route_hash(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t prefix_len,
+                                  ip_addr_type_t type) {
+    uint32_t hash;
+
+    if (type == IP_TYPE_V4) {
+        hash = hash_ipv4_prefix(&prefix->addr.v4, prefix_len);
+    } else {
+        hash = hash_ipv6_prefix(&prefix->addr.v6, prefix_len);
+    }
+
+    /* The same prefix in different VRFs lands in different buckets */
+    return hash ^ ((uint32_t)vrf_id * 0x9E3779B1U);
+}
+
+/**
+ * @brief Find the hash chain link that holds a prefix
+ *
+ * @param vrf_id VRF of the prefix
+ * @param prefix Masked IP address prefix
+ * @param prefix_len Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ * @return Link pointing at the prefix's best candidate, or at NULL at the
+ *         end of the chain if the prefix is not in the RIB
+ */
+static rib_entry_t **find_route_link(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t prefix_len,
+                                     ip_addr_type_t type) {
+    rib_entry_t **link;
+    uint32_t hash_index = route_hash(vrf_id, prefix, prefix_len, type) & (g_routing_table.hash_size - 1);
+
+    for (link = &g_routing_table.hash_table[hash_index]; *link; link = &(*link)->next) {
+        if ((*link)->vrf_id == vrf_id &&
+            (*link)->info.addr_type == type &&
+            (*link)->info.prefix_len == prefix_len &&
+            memcmp(route_addr_bytes(&(*link)->info.prefix, type), route_addr_bytes(prefix, type),
+                   (type == IP_TYPE_V4 ? IPV4_ADDR_LEN : IPV6_ADDR_LEN)) == 0) {
+            break;
+        }
+    }
+
+    return link;
+}
+
+/**
+ * @brief Find a route with exact match
+ *
+ * @param vrf_id VRF of the prefix
+ * @param prefix Masked IP address prefix
+ * @param prefix_len Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ * @return Best candidate for the prefix if found, NULL otherwise
+ */
+static rib_entry_t *find_route_exact(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t prefix_len,
+                                     ip_addr_type_t type) {
+    return *find_route_link(vrf_id, prefix, prefix_len, type);
+}
+
+/**
+ * @brief Find the longest installed prefix that strictly contains another
+ *
+ * Prefixes whose best candidate is not in the FIB, such as a leak its
+ * source VRF has no route for, are passed over.
+ *
+ * @param vrf_id VRF of the prefix
+ * @param prefix Masked IP address prefix
+ * @param prefix_len Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ * @return Best candidate of the covering prefix, NULL if there is none
+ */
+static rib_entry_t *find_route_covering(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t prefix_len,
+                                        ip_addr_type_t type) {
+    rib_entry_t *entry;
+    ip_addr_t shorter = *prefix;
+
+    while (prefix_len-- > 0) {
+        mask_prefix(&shorter, prefix_len, type);
+        entry = find_route_exact(vrf_id, &shorter, prefix_len, type);
+        if (entry && entry->group_index != 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief RIB entry a FIB leaf names
+ *
+ * @param chunks Chunk directory loaded after the leaf
+ * @param leaf Leaf of an installed route
+ * @return Installed candidate of the prefix
+ */
+static inline const rib_entry_t *rib_entry_at(rib_chunk_t *const *chunks, uint32_t leaf) {
+    uint32_t index = (leaf & LPM_ROUTE_MASK) - 1;
+
+    return &chunks[index / ROUTE_ARENA_CHUNK]->entries[index % ROUTE_ARENA_CHUNK];
+}
+
+/**
+ * @brief Find a route using longest prefix match
+ *
+ * Lock-free; must be called inside an RCU read section. The entry stays
+ * readable until the section ends, even if it is removed meanwhile.
+ *
+ * @param vrf_id VRF to look in
+ * @param addr IP address to match
+ * @param type IP address type (IPv4 or IPv6)
+ * @return Installed candidate of the matching prefix if found, NULL otherwise
+ */
+static const rib_entry_t *find_route_lpm(uint16_t vrf_id, const ip_addr_t *addr, ip_addr_type_t type) {
+    const fib_vrf_t *vrf = __atomic_load_n(&g_routing_table.vrfs[vrf_id], __ATOMIC_ACQUIRE);
+    rib_chunk_t *const *chunks;
+    uint32_t leaf;
+
+    if (!vrf) {
+        return NULL;
+    }
+
+    leaf = lpm_trie_lookup((type == IP_TYPE_V4) ? &vrf->v4 : &vrf->v6, route_addr_bytes(addr, type));
+    if (leaf == LPM_LEAF_NONE) {
+        return NULL;
+    }
+
+    /* Loaded after the leaf, so it holds the chunk of the entry */
+    chunks = __atomic_load_n(&g_routing_table.chunks, __ATOMIC_ACQUIRE);
+
+    return rib_entry_at(chunks, leaf);
+}
+
+/**
+ * @brief Find the next-hop group an address is forwarded through
+ *
+ * Lock-free; must be called inside an RCU read section.
+ *
+ * @param vrf_id VRF to look in
+ * @param addr IP address to match
+ * @param type IP address type (IPv4 or IPv6)
+ * @return Next-hop group index, 0 if no route matches
+ */
+static uint32_t fib_lookup_group(uint16_t vrf_id, const ip_addr_t *addr, ip_addr_type_t type) {
+    const rib_entry_t *entry;
+    uint32_t group_index;
+
+    /* A route withdrawn after its leaf was read has no group; look again */
+    do {
+        entry = find_route_lpm(vrf_id, addr, type);
+        if (!entry) {
+            return 0;
+        }
+        group_index = __atomic_load_n(&entry->group_index, __ATOMIC_ACQUIRE);
+    } while (group_index == 0);
+
+    return group_index;
+}
+
+/**
+ * @brief Get the calling thread's lookup cache, creating it on first use
+ *
+ * @return Cache, NULL if none could be created
+ */
+static route_cache_t *route_cache_get(void) {
+    uint32_t epoch = __atomic_load_n(&g_route_cache_epoch, __ATOMIC_ACQUIRE);
+    route_cache_t *cache = NULL;
+
+    if (t_route_cache && t_route_cache_epoch == epoch) {
+        return t_route_cache;
+    }
+
+    if ((cache = mem_aligned_alloc(MEM_TAG_FIB, ROUTE_CACHE_ALIGN, sizeof(route_cache_t))) == NULL) {
+        return NULL;
+    }
+    memset(cache, 0, sizeof(*cache));
+
+    ROUTING_LOCK();
+    if (g_routing_table.cache_count >= ROUTE_CACHE_MAX_WORKERS) {
+        ROUTING_UNLOCK();
+        mem_free(MEM_TAG_FIB, cache);
+        LOG_WARNING(LOG_CATEGORY_L3, "No route lookup cache left for this thread");
+        return NULL;
+    }
+    g_routing_table.caches[g_routing_table.cache_count] = cache;
+    /* Publish the cache after it is set up */
+    __atomic_store_n(&g_routing_table.cache_count, g_routing_table.cache_count + 1, __ATOMIC_RELEASE);
+    ROUTING_UNLOCK();
+
+    t_route_cache = cache;
+    t_route_cache_epoch = epoch;
+    return cache;
+}
+
+/**
+ * @brief Get the cache slot of a destination
+ *
+ * @param vrf_id VRF looked in
+ * @param addr Destination address
+ * @param type IP address type (IPv4 or IPv6)
+ * @return Slot index
+ */
+static inline uint32_t route_cache_index(uint16_t vrf_id, const ip_addr_t *addr, ip_addr_type_t type) {
+    const uint8_t *bytes = route_addr_bytes(addr, type);
+    uint8_t len = (type == IP_TYPE_V4) ? IPV4_ADDR_LEN : IPV6_ADDR_LEN;
+    uint32_t hash = vrf_id;
+    uint32_t word;
+    uint8_t i;
+
+    for (i = 0; i < len; i += 4) {
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 0x9E3779B1U;
+    }
+
+    return hash >> (32 - ROUTE_CACHE_BITS);
+}
+
+/**
+ * @brief Find the installed route of an address through the worker's cache
+ *
+ * Lock-free; must be called inside an RCU read section. A result is reused
+ * until the FIB generation moves on, so hot destinations skip the trie
+ * walk. Without a cache this is find_route_lpm().
+ *
+ * @param vrf_id VRF to look in
+ * @param addr IP address to match
+ * @param type IP address type (IPv4 or IPv6)
+ * @return Installed candidate of the matching prefix if found, NULL otherwise
+ */
+static const rib_entry_t *fib_lookup_cached(uint16_t vrf_id, const ip_addr_t *addr, ip_addr_type_t type) {
+    uint8_t len = (type == IP_TYPE_V4) ? IPV4_ADDR_LEN : IPV6_ADDR_LEN;
+    route_cache_t *cache = NULL;
+    route_cache_slot_t *slot;
+    const rib_entry_t *entry;
+    uint32_t generation;
+
+    if (__atomic_load_n(&g_routing_table.lookup_cache_enabled, __ATOMIC_RELAXED)) {
+        cache = route_cache_get();
+    }
+    if (!cache) {
+        return find_route_lpm(vrf_id, addr, type);
+    }
+
+    /* Loaded before the walk, so a change made meanwhile retires the result */
+    generation = __atomic_load_n(&g_routing_table.fib_generation, __ATOMIC_ACQUIRE);
+    slot = &cache->slots[route_cache_index(vrf_id, addr, type)];
+    if (slot->generation == generation && slot->vrf_id == vrf_id && slot->type == (uint8_t)type &&
+        memcmp(route_addr_bytes(&slot->addr, type), route_addr_bytes(addr, type), len) == 0) {
+        __atomic_store_n(&cache->hits, cache->hits + 1, __ATOMIC_RELAXED);
+        return slot->entry;
+    }
+
+    __atomic_store_n(&cache->misses, cache->misses + 1, __ATOMIC_RELAXED);
+    entry = find_route_lpm(vrf_id, addr, type);
+
+    slot->addr = *addr;
+    slot->entry = entry;
+    slot->vrf_id = vrf_id;
+    slot->type = (uint8_t)type;
+    slot->generation = generation;
+
+    return entry;
+}
+
+
+
+/* --- FIB OPERATIONS ------------------------------------------------------- */
+
+/*
+ * Each address family has a multibit trie: a root table indexed by the top
+ * root_bits of the address (24 for IPv4, making it DIR-24-8; 16 for IPv6)
+ * and 8-bit strides below it. Every level is a flat array of 32-bit entries
+ * holding either a leaf (prefix length and installed RIB entry) or, with
+ * LPM_ENTRY_EXT set, the number of the child node resolving the next octet.
+ * Child nodes are 1 KiB, cache-line aligned and packed in one array, so a
+ * level is one indexed load. Prefixes are expanded over the entries they
+ * cover; the prefix length in each leaf tells updates which entries a
+ * longer prefix already owns.
+ *
+ * Next hops are shared: every path to the same address out of the same
+ * interface refers to one reference counted next-hop entry, and every prefix
+ * with the same set of equal-cost paths to one next-hop group. Changing a
+ * next hop's state touches one object, not the routes using it. A group maps
+ * NHGROUP_BUCKETS flow hash buckets to its members, and only the buckets of
+ * a failed or recovered path are remapped.
+ */
+
+static inline uint32_t lpm_leaf(uint8_t depth, uint32_t route_index) {
+    return ((uint32_t)depth << LPM_DEPTH_SHIFT) | route_index;
+}
+
+static inline uint8_t lpm_leaf_depth(uint32_t leaf) {
+    return (leaf >> LPM_DEPTH_SHIFT) & LPM_DEPTH_MASK;
+}
+
+/**
+ * @brief Store a trie entry that readers may be loading
+ *
+ * The release store makes a new child node's contents visible before it is.
+ *
+ * @param entry Trie entry
+ * @param value Leaf or child node reference
+ */
+static inline void lpm_entry_store(uint32_t *entry, uint32_t value) {
+    __atomic_store_n(entry, value, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Get the table of a trie node
+ *
+ * The pointer is only valid until the next node allocation.
+ *
+ * @param trie Trie
+ * @param node_id Node number or LPM_NODE_ROOT
+ * @return First entry of the node
+ */
+static inline uint32_t *lpm_table(const lpm_trie_t *trie, uint32_t node_id) {
+    if (node_id == LPM_NODE_ROOT) {
+        return trie->root;
+    }
+    return &trie->nodes[(size_t)node_id * LPM_NODE_SIZE];
+}
+
+/**
+ * @brief Get the index of an address in the table of a trie level
+ *
+ * @param trie Trie
+ * @param addr Address bytes in network order
+ * @param level Trie level, 0 for the root
+ * @return Table index
+ */
+static inline uint32_t lpm_level_index(const lpm_trie_t *trie, const uint8_t *addr, uint8_t level) {
+    uint8_t root_bytes = trie->root_bits / 8;
+    uint32_t index = 0;
+    uint8_t i;
+
+    if (level > 0) {
+        return addr[root_bytes + level - 1];
+    }
+
+    for (i = 0; i < root_bytes; i++) {
+        index = (index << 8) | addr[i];
+    }
+
+    return index;
+}
+
+/**
+ * @brief Allocate a trie with no routes
+ *
+ * @param trie Trie to set up
+ * @param root_bits Stride of the root table, a multiple of 8
+ * @return STATUS_SUCCESS if successful, STATUS_NO_MEMORY otherwise
+ */
+static status_t lpm_trie_init(lpm_trie_t *trie, uint8_t root_bits) {
+    mem_arena_t *arena = mem_arena_get(FIB_ARENA);
+
+    memset(trie, 0, sizeof(*trie));
+    trie->root_bits = root_bits;
+    /* The root table is the bulk of every lookup's misses, so it goes on huge pages */
+    trie->root = (uint32_t *)mem_arena_alloc(arena, ((size_t)1 << root_bits) * sizeof(uint32_t),
+                                             LPM_NODE_ALIGN);
+    trie->nodes = (uint32_t *)mem_arena_alloc(arena, LPM_NODE_BYTES(LPM_INITIAL_NODES), LPM_NODE_ALIGN);
+    if (!trie->root || !trie->nodes) {
+        mem_arena_free(arena, trie->root, ((size_t)1 << root_bits) * sizeof(uint32_t));
+        mem_arena_free(arena, trie->nodes, LPM_NODE_BYTES(LPM_INITIAL_NODES));
+        memset(trie, 0, sizeof(*trie));
+        return STATUS_NO_MEMORY;
+    }
+
+    trie->node_capacity = LPM_INITIAL_NODES;
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Free a trie
+ *
+ * @param trie Trie
+ */
+static void lpm_trie_deinit(lpm_trie_t *trie) {
+    mem_arena_t *arena = mem_arena_get(FIB_ARENA);
+
+    mem_arena_free(arena, trie->root, ((size_t)1 << trie->root_bits) * sizeof(uint32_t));
+    mem_arena_free(arena, trie->nodes, LPM_NODE_BYTES(trie->node_capacity));
+    mem_free(MEM_TAG_FIB, trie->limbo);
+    memset(trie, 0, sizeof(*trie));
+}
+
+/**
+ * @brief Remove every route from a trie
+ *
+ * Allocated nodes are kept for reuse, which must wait until no reader can
+ * still be walking them.
+ *
+ * @param trie Trie
+ */
+static void lpm_trie_flush(lpm_trie_t *trie) {
+    uint32_t i;
+
+    for (i = 0; i < (1U << trie->root_bits); i++) {
+        lpm_entry_store(&trie->root[i], LPM_LEAF_NONE);
+    }
+    trie->node_next = 0;
+    trie->node_count = 0;
+    trie->free_head = 0;
+    trie->limbo_count = 0;
+    trie->folded_count = 0;
+}
+
+/**
+ * @brief Put the nodes freed before the last grace period on the free list
+ *
+ * @param trie Trie
+ */
+static void lpm_trie_reclaim(lpm_trie_t *trie) {
+    uint32_t i;
+
+    for (i = 0; i < trie->limbo_count; i++) {
+        lpm_table(trie, trie->limbo[i])[0] = trie->free_head;
+        trie->free_head = trie->limbo[i] + 1;
+    }
+    trie->limbo_count = 0;
+}
+
+/**
+ * @brief Get the memory held by a trie
+ *
+ * @param trie Trie
+ * @return Bytes allocated for the root table and nodes
+ */
+static uint64_t lpm_trie_memory(const lpm_trie_t *trie) {
+    return (((uint64_t)1 << trie->root_bits) + (uint64_t)trie->node_capacity * LPM_NODE_SIZE) *
+           sizeof(uint32_t);
+}
+
+/**
+ * @brief Allocate a trie node with every entry set to one value
+ *
+ * May move the node array, invalidating pointers from lpm_table(). Readers
+ * that loaded the old array keep walking it until it is retired.
+ *
+ * @param trie Trie
+ * @param fill Value of every entry
+ * @param[out] node_id Number of the new node
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+static status_t lpm_alloc_node(lpm_trie_t *trie, uint32_t fill, uint32_t *node_id) {
+    uint32_t *nodes;
+    uint32_t *table;
+    uint32_t id;
     uint32_t i;
-    route_entry_t *current;
-    for (i = 0; i < ROUTE_HASH_SIZE; i++) {
-        current = g_routing_table.hash_table[i];
-        while (current) {
-            if (current != entry) {
-                insert_to_lpm_tree(current);
+
+    if (trie->free_head == 0 && trie->limbo_count >= FIB_RECLAIM_BATCH) {
+        fib_reclaim();
+    }
+
+    if (trie->free_head != 0) {
+        /* A freed node keeps the free list link in its first entry */
+        id = trie->free_head - 1;
+        trie->free_head = lpm_table(trie, id)[0];
+    } else {
+        if (trie->node_next == trie->node_capacity) {
+            if (trie->node_capacity > LPM_NODE_MASK / 2) {
+                return STATUS_TABLE_FULL;
+            }
+
+            nodes = (uint32_t *)mem_arena_alloc(mem_arena_get(FIB_ARENA),
+                                                LPM_NODE_BYTES(trie->node_capacity * 2), LPM_NODE_ALIGN);
+            if (!nodes) {
+                return STATUS_NO_MEMORY;
             }
-            current = current->next;
+
+            memcpy(nodes, trie->nodes, LPM_NODE_BYTES(trie->node_capacity));
+            fib_retire_array(trie->nodes, LPM_NODE_BYTES(trie->node_capacity));
+            __atomic_store_n(&trie->nodes, nodes, __ATOMIC_RELEASE);
+            trie->node_capacity *= 2;
+        }
+        id = trie->node_next++;
+    }
+
+    table = lpm_table(trie, id);
+    for (i = 0; i < LPM_NODE_SIZE; i++) {
+        table[i] = fill;
+    }
+
+    trie->node_count++;
+    *node_id = id;
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Return a trie node to the free list after a grace period
+ *
+ * Readers may still be walking the node, so it is left untouched until
+ * fib_reclaim().
+ *
+ * @param trie Trie
+ * @param node_id Node number, already unlinked from its parent
+ */
+static void lpm_free_node(lpm_trie_t *trie, uint32_t node_id) {
+    uint32_t *limbo;
+    uint32_t capacity;
+
+    trie->node_count--;
+
+    if (trie->limbo_count == trie->limbo_capacity) {
+        capacity = trie->limbo_capacity ? trie->limbo_capacity * 2 : FIB_RECLAIM_BATCH;
+        limbo = (uint32_t *)mem_realloc(MEM_TAG_FIB, trie->limbo, capacity * sizeof(uint32_t));
+        if (!limbo) {
+            /* Wait out the readers instead */
+            fib_reclaim();
+            lpm_table(trie, node_id)[0] = trie->free_head;
+            trie->free_head = node_id + 1;
+            return;
         }
+        trie->limbo = limbo;
+        trie->limbo_capacity = capacity;
+    }
+
+    trie->limbo[trie->limbo_count++] = node_id;
+}
+
+/**
+ * @brief Point the entries not owned by a longer prefix at a leaf
+ *
+ * Entries that refer to a child node are resolved inside the child.
+ *
+ * @param trie Trie
+ * @param table First entry of the node
+ * @param first First entry to update
+ * @param count Number of entries to update
+ * @param leaf Leaf of the new prefix
+ */
+static void lpm_table_insert(lpm_trie_t *trie, uint32_t *table, uint32_t first, uint32_t count,
+                             uint32_t leaf) {
+    uint32_t i;
+
+    for (i = first; i < first + count; i++) {
+        if (table[i] & LPM_ENTRY_EXT) {
+            lpm_table_insert(trie, lpm_table(trie, table[i] & LPM_NODE_MASK), 0, LPM_NODE_SIZE, leaf);
+        } else if (lpm_leaf_depth(table[i]) <= lpm_leaf_depth(leaf)) {
+            lpm_entry_store(&table[i], leaf);
+        }
+    }
+}
+
+/**
+ * @brief Replace the leaves of one prefix in a range of entries
+ *
+ * Inside the range of a prefix, the only leaves of its length are its own.
+ *
+ * @param trie Trie
+ * @param table First entry of the node
+ * @param first First entry to update
+ * @param count Number of entries to update
+ * @param depth Prefix length whose leaves are replaced
+ * @param leaf Leaf taking over, LPM_LEAF_NONE to clear
+ */
+static void lpm_table_replace(lpm_trie_t *trie, uint32_t *table, uint32_t first, uint32_t count,
+                              uint8_t depth, uint32_t leaf) {
+    uint32_t i;
+
+    for (i = first; i < first + count; i++) {
+        if (table[i] & LPM_ENTRY_EXT) {
+            lpm_table_replace(trie, lpm_table(trie, table[i] & LPM_NODE_MASK), 0, LPM_NODE_SIZE,
+                              depth, leaf);
+        } else if (table[i] != LPM_LEAF_NONE && lpm_leaf_depth(table[i]) == depth) {
+            lpm_entry_store(&table[i], leaf);
+        }
+    }
+}
+
+/**
+ * @brief Add a prefix to a trie
+ *
+ * @param trie Trie
+ * @param prefix Prefix bytes in network order
+ * @param depth Prefix length
+ * @param leaf Leaf of the prefix
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+static status_t lpm_trie_insert(lpm_trie_t *trie, const uint8_t *prefix, uint8_t depth, uint32_t leaf) {
+    uint32_t node_id = LPM_NODE_ROOT;
+    uint32_t level_end = trie->root_bits;
+    uint32_t *table;
+    uint32_t child;
+    uint32_t index;
+    uint32_t span;
+    uint8_t level;
+    status_t status;
+
+    for (level = 0; ; level++) {
+        index = lpm_level_index(trie, prefix, level);
+
+        if (depth <= level_end) {
+            /* The prefix ends in this level: expand it over the entries it covers */
+            span = 1U << (level_end - depth);
+            lpm_table_insert(trie, lpm_table(trie, node_id), index & ~(span - 1), span, leaf);
+            return STATUS_SUCCESS;
+        }
+
+        table = lpm_table(trie, node_id);
+        if (!(table[index] & LPM_ENTRY_EXT)) {
+            /* The new node inherits the route that covered the whole entry */
+            status = lpm_alloc_node(trie, table[index], &child);
+            if (status != STATUS_SUCCESS) {
+                return status;
+            }
+            lpm_entry_store(&lpm_table(trie, node_id)[index], LPM_ENTRY_EXT | child);
+        }
+
+        node_id = lpm_table(trie, node_id)[index] & LPM_NODE_MASK;
+        level_end += LPM_STRIDE_BITS;
+    }
+}
+
+/**
+ * @brief Replace the leaves of a prefix in a trie
+ *
+ * Nodes on the prefix's path that no longer differ by address are folded
+ * into their parent entry.
+ *
+ * @param trie Trie
+ * @param prefix Prefix bytes in network order
+ * @param depth Prefix length
+ * @param leaf Leaf taking over, LPM_LEAF_NONE to clear
+ */
+static void lpm_trie_replace(lpm_trie_t *trie, const uint8_t *prefix, uint8_t depth, uint32_t leaf) {
+    uint32_t path_node[LPM_MAX_LEVELS];
+    uint32_t path_index[LPM_MAX_LEVELS];
+    uint32_t node_id = LPM_NODE_ROOT;
+    uint32_t level_end = trie->root_bits;
+    uint32_t *table;
+    uint32_t index;
+    uint32_t span;
+    uint32_t i;
+    uint8_t level;
+
+    for (level = 0; ; level++) {
+        index = lpm_level_index(trie, prefix, level);
+        table = lpm_table(trie, node_id);
+        path_node[level] = node_id;
+        path_index[level] = index;
+
+        if (depth <= level_end) {
+            span = 1U << (level_end - depth);
+            lpm_table_replace(trie, table, index & ~(span - 1), span, depth, leaf);
+            break;
+        }
+
+        if (!(table[index] & LPM_ENTRY_EXT)) {
+            return;
+        }
+
+        node_id = table[index] & LPM_NODE_MASK;
+        level_end += LPM_STRIDE_BITS;
+    }
+
+    for (; level > 0; level--) {
+        table = lpm_table(trie, path_node[level]);
+        if ((table[0] & LPM_ENTRY_EXT) || lpm_leaf_depth(table[0]) == LPM_DEPTH_FOLDED) {
+            return;
+        }
+        for (i = 1; i < LPM_NODE_SIZE; i++) {
+            if (table[i] != table[0]) {
+                return;
+            }
+        }
+
+        lpm_entry_store(&lpm_table(trie, path_node[level - 1])[path_index[level - 1]], table[0]);
+        lpm_free_node(trie, path_node[level]);
+    }
+}
+
+/**
+ * @brief Find the leaf of the longest prefix matching an address
+ *
+ * Lock-free; must be called inside an RCU read section.
+ *
+ * @param trie Trie
+ * @param addr Address bytes in network order
+ * @return Leaf, LPM_LEAF_NONE if no prefix matches
+ */
+static uint32_t lpm_trie_lookup(const lpm_trie_t *trie, const uint8_t *addr) {
+    uint32_t entry = __atomic_load_n(&trie->root[lpm_level_index(trie, addr, 0)], __ATOMIC_ACQUIRE);
+    const uint8_t *octet = addr + trie->root_bits / 8;
+    const uint32_t *nodes;
+
+    if (!(entry & LPM_ENTRY_EXT)) {
+        return entry;
+    }
+
+    /*
+     * Loaded after the root entry, so it holds every node that entry leads
+     * to. An array replaced meanwhile is a frozen copy that stays consistent
+     * until the read section ends.
+     */
+    nodes = __atomic_load_n(&trie->nodes, __ATOMIC_ACQUIRE);
+    do {
+        entry = __atomic_load_n(&nodes[(size_t)(entry & LPM_NODE_MASK) * LPM_NODE_SIZE + *octet++],
+                                __ATOMIC_ACQUIRE);
+    } while (entry & LPM_ENTRY_EXT);
+
+    return entry;
+}
+
+/**
+ * @brief Find the leaves of a burst of addresses
+ *
+ * Walks the burst one trie level at a time: the entries every address needs
+ * at a level are prefetched together, so their misses overlap instead of
+ * each lookup waiting out its own.
+ *
+ * @param trie Trie of the address family
+ * @param addrs Address bytes, at most ROUTING_LOOKUP_BULK_MAX of them
+ * @param n Number of addresses
+ * @param[out] leaves Leaf of each address, LPM_LEAF_NONE if no route
+ */
+static void lpm_trie_lookup_bulk(const lpm_trie_t *trie, const uint8_t *const *addrs, uint32_t n,
+                                 uint32_t *leaves) {
+    const uint32_t *slots[ROUTING_LOOKUP_BULK_MAX];
+    uint8_t pending[ROUTING_LOOKUP_BULK_MAX];
+    uint8_t octet = trie->root_bits / 8;
+    const uint32_t *nodes;
+    uint32_t pending_count = 0;
+    uint32_t count;
+    uint32_t entry;
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        slots[i] = &trie->root[lpm_level_index(trie, addrs[i], 0)];
+        __builtin_prefetch(slots[i]);
+    }
+
+    for (i = 0; i < n; i++) {
+        leaves[i] = __atomic_load_n(slots[i], __ATOMIC_ACQUIRE);
+        if (leaves[i] & LPM_ENTRY_EXT) {
+            pending[pending_count++] = (uint8_t)i;
+        }
+    }
+
+    if (pending_count == 0) {
+        return;
+    }
+
+    /* Loaded after every root entry, as in lpm_trie_lookup() */
+    nodes = __atomic_load_n(&trie->nodes, __ATOMIC_ACQUIRE);
+
+    while (pending_count > 0) {
+        for (i = 0; i < pending_count; i++) {
+            slots[pending[i]] = &nodes[(size_t)(leaves[pending[i]] & LPM_NODE_MASK) * LPM_NODE_SIZE +
+                                       addrs[pending[i]][octet]];
+            __builtin_prefetch(slots[pending[i]]);
+        }
+
+        count = pending_count;
+        pending_count = 0;
+        for (i = 0; i < count; i++) {
+            entry = __atomic_load_n(slots[pending[i]], __ATOMIC_ACQUIRE);
+            leaves[pending[i]] = entry;
+            if (entry & LPM_ENTRY_EXT) {
+                pending[pending_count++] = pending[i];
+            }
+        }
+        octet++;
+    }
+}
+
+/**
+ * @brief Get a trie of a VRF
+ *
+ * @param vrf_id Existing VRF
+ * @param type IP address type (IPv4 or IPv6)
+ * @return Trie
+ */
+static inline lpm_trie_t *fib_trie(uint16_t vrf_id, ip_addr_type_t type) {
+    fib_vrf_t *vrf = g_routing_table.vrfs[vrf_id];
+
+    return (type == IP_TYPE_V4) ? &vrf->v4 : &vrf->v6;
+}
+
+/**
+ * @brief Retire every cached lookup result
+ *
+ * Called after the FIB changed, once the change is visible to readers.
+ */
+static inline void fib_changed(void) {
+    __atomic_store_n(&g_routing_table.fib_generation, g_routing_table.fib_generation + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Create the empty FIB of a VRF
+ *
+ * @param vrf_id VRF with no FIB yet
+ * @return STATUS_SUCCESS if successful, STATUS_NO_MEMORY otherwise
+ */
+static status_t fib_vrf_create(uint16_t vrf_id) {
+    fib_vrf_t *vrf = (fib_vrf_t *)mem_calloc(MEM_TAG_FIB, 1, sizeof(fib_vrf_t));
+
+    if (!vrf) {
+        return STATUS_NO_MEMORY;
+    }
+
+    if (lpm_trie_init(&vrf->v4, LPM_V4_ROOT_BITS) != STATUS_SUCCESS) {
+        mem_free(MEM_TAG_FIB, vrf);
+        return STATUS_NO_MEMORY;
+    }
+
+    if (lpm_trie_init(&vrf->v6, LPM_V6_ROOT_BITS) != STATUS_SUCCESS) {
+        lpm_trie_deinit(&vrf->v4);
+        mem_free(MEM_TAG_FIB, vrf);
+        return STATUS_NO_MEMORY;
+    }
+
+    __atomic_store_n(&g_routing_table.vrfs[vrf_id], vrf, __ATOMIC_RELEASE);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Free the FIB of a VRF once no reader can still walk it
+ *
+ * @param vrf_id VRF with a FIB
+ */
+static void fib_vrf_destroy(uint16_t vrf_id) {
+    fib_vrf_t *vrf = g_routing_table.vrfs[vrf_id];
+
+    __atomic_store_n(&g_routing_table.vrfs[vrf_id], NULL, __ATOMIC_RELEASE);
+    rcu_synchronize();
+
+    lpm_trie_deinit(&vrf->v4);
+    lpm_trie_deinit(&vrf->v6);
+    mem_free(MEM_TAG_FIB, vrf);
+}
+
+/**
+ * @brief Allocate the FIB with no routes and only the default VRF
+ *
+ * @return STATUS_SUCCESS if successful, STATUS_NO_MEMORY otherwise
+ */
+static status_t fib_init(void) {
+    if (fib_vrf_create(ROUTING_VRF_DEFAULT) != STATUS_SUCCESS) {
+        return STATUS_NO_MEMORY;
+    }
+
+    g_routing_table.nexthops = (fib_nexthop_t *)mem_calloc(MEM_TAG_FIB, NEXTHOP_INITIAL_CAPACITY, sizeof(fib_nexthop_t));
+    if (!g_routing_table.nexthops) {
+        fib_vrf_destroy(ROUTING_VRF_DEFAULT);
+        return STATUS_NO_MEMORY;
+    }
+
+    g_routing_table.groups = (fib_nhgroup_t *)mem_calloc(MEM_TAG_FIB, NHGROUP_INITIAL_CAPACITY, sizeof(fib_nhgroup_t));
+    if (!g_routing_table.groups) {
+        mem_free(MEM_TAG_FIB, g_routing_table.nexthops);
+        g_routing_table.nexthops = NULL;
+        fib_vrf_destroy(ROUTING_VRF_DEFAULT);
+        return STATUS_NO_MEMORY;
+    }
+
+    g_routing_table.nexthop_capacity = NEXTHOP_INITIAL_CAPACITY;
+    g_routing_table.group_capacity = NHGROUP_INITIAL_CAPACITY;
+    /* Generation 0 marks empty cache slots */
+    g_routing_table.fib_generation = 1;
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Free the lookup cache of every worker
+ *
+ * No lookup may be in flight. Threads notice the new epoch and build a
+ * fresh cache on their next lookup.
+ */
+static void fib_free_caches(void) {
+    uint32_t i;
+
+    for (i = 0; i < g_routing_table.cache_count; i++) {
+        mem_free(MEM_TAG_FIB, g_routing_table.caches[i]);
+        g_routing_table.caches[i] = NULL;
+    }
+    g_routing_table.cache_count = 0;
+    __atomic_store_n(&g_route_cache_epoch, g_route_cache_epoch + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Sum the hits and misses of every worker's lookup cache
+ *
+ * Counters are read while their workers keep counting, so the totals are
+ * a snapshot that may trail by a few lookups.
+ *
+ * @param[out] stats Statistics to fill in
+ */
+static void fib_get_cache_stats(routing_table_stats_t *stats) {
+    uint32_t count = __atomic_load_n(&g_routing_table.cache_count, __ATOMIC_ACQUIRE);
+    uint32_t i;
+
+    stats->lookup_cache_enabled = g_routing_table.lookup_cache_enabled;
+    stats->lookup_cache_hits = 0;
+    stats->lookup_cache_misses = 0;
+    for (i = 0; i < count; i++) {
+        stats->lookup_cache_hits += __atomic_load_n(&g_routing_table.caches[i]->hits, __ATOMIC_RELAXED);
+        stats->lookup_cache_misses += __atomic_load_n(&g_routing_table.caches[i]->misses, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Free the FIB of every VRF
+ */
+static void fib_deinit(void) {
+    uint32_t i;
+
+    fib_free_caches();
+    for (i = 0; i < ROUTING_MAX_VRFS; i++) {
+        if (g_routing_table.vrfs[i]) {
+            fib_vrf_destroy((uint16_t)i);
+        }
+    }
+    mem_free(MEM_TAG_FIB, g_routing_table.nexthops);
+    g_routing_table.nexthops = NULL;
+    g_routing_table.nexthop_capacity = 0;
+    g_routing_table.nexthop_next = 0;
+    g_routing_table.nexthop_count = 0;
+    g_routing_table.nexthop_free = 0;
+    g_routing_table.nexthop_limbo = 0;
+    g_routing_table.nexthop_limbo_count = 0;
+    memset(g_routing_table.nexthop_hash, 0, sizeof(g_routing_table.nexthop_hash));
+    mem_free(MEM_TAG_FIB, g_routing_table.groups);
+    g_routing_table.groups = NULL;
+    g_routing_table.group_capacity = 0;
+    g_routing_table.group_next = 0;
+    g_routing_table.group_count = 0;
+    g_routing_table.group_free = 0;
+    g_routing_table.group_limbo = 0;
+    g_routing_table.group_limbo_count = 0;
+    memset(g_routing_table.group_hash, 0, sizeof(g_routing_table.group_hash));
+}
+
+/**
+ * @brief Remove every prefix, group and next hop from the FIB
+ *
+ * Returns once no reader can still see any of them, so the caller may free
+ * the RIB entries they named.
+ */
+static void fib_flush(void) {
+    uint32_t i;
+
+    /* VRFs stay, empty */
+    for (i = 0; i < ROUTING_MAX_VRFS; i++) {
+        if (g_routing_table.vrfs[i]) {
+            lpm_trie_flush(&g_routing_table.vrfs[i]->v4);
+            lpm_trie_flush(&g_routing_table.vrfs[i]->v6);
+            g_routing_table.vrfs[i]->route_count = 0;
+        }
+    }
+    /* Cached results name entries that are about to be freed */
+    fib_changed();
+    rcu_synchronize();
+
+    g_routing_table.nexthop_next = 0;
+    g_routing_table.nexthop_count = 0;
+    g_routing_table.nexthop_free = 0;
+    g_routing_table.nexthop_limbo = 0;
+    g_routing_table.nexthop_limbo_count = 0;
+    memset(g_routing_table.nexthop_hash, 0, sizeof(g_routing_table.nexthop_hash));
+    g_routing_table.group_next = 0;
+    g_routing_table.group_count = 0;
+    g_routing_table.group_free = 0;
+    g_routing_table.group_limbo = 0;
+    g_routing_table.group_limbo_count = 0;
+    memset(g_routing_table.group_hash, 0, sizeof(g_routing_table.group_hash));
+}
+
+/**
+ * @brief RCU destructor for a replaced array
+ *
+ * @param head RCU header embedded in the retirement record
+ */
+static void fib_free_array(rcu_head_t *head) {
+    fib_retired_array_t *retired = (fib_retired_array_t *)((char *)head - offsetof(fib_retired_array_t, rcu));
+
+    if (retired->arena_size) {
+        mem_arena_free(mem_arena_get(FIB_ARENA), retired->mem, retired->arena_size);
+    } else {
+        mem_free(MEM_TAG_FIB, retired->mem);
+    }
+    mem_free(MEM_TAG_FIB, retired);
+}
+
+/**
+ * @brief Free an array once readers that may have loaded it are done
+ *
+ * @param mem Array that is no longer published
+ * @param arena_size Bytes of the array in the FIB arena, 0 for heap memory
+ */
+static void fib_retire_array(void *mem, size_t arena_size) {
+    fib_retired_array_t *retired = (fib_retired_array_t *)mem_malloc(MEM_TAG_FIB, sizeof(fib_retired_array_t));
+
+    if (!retired) {
+        rcu_synchronize();
+        if (arena_size) {
+            mem_arena_free(mem_arena_get(FIB_ARENA), mem, arena_size);
+        } else {
+            mem_free(MEM_TAG_FIB, mem);
+        }
+        return;
+    }
+
+    retired->mem = mem;
+    retired->arena_size = arena_size;
+    rcu_retire(&retired->rcu, fib_free_array);
+}
+
+/**
+ * @brief Make freed RIB entries, trie nodes, groups and next hops reusable
+ *
+ * Waits for every read section that may still use them; writers call it
+ * only once a pool has FIB_RECLAIM_BATCH objects waiting.
+ */
+static void fib_reclaim(void) {
+    rib_entry_t *entry;
+    uint32_t index;
+    uint32_t i;
+
+    rcu_synchronize();
+
+    while ((entry = g_routing_table.limbo_entries) != NULL) {
+        g_routing_table.limbo_entries = entry->next;
+        entry->next = g_routing_table.free_entries;
+        g_routing_table.free_entries = entry;
+    }
+    g_routing_table.limbo_entry_count = 0;
+
+    for (i = 0; i < ROUTING_MAX_VRFS; i++) {
+        if (g_routing_table.vrfs[i]) {
+            lpm_trie_reclaim(&g_routing_table.vrfs[i]->v4);
+            lpm_trie_reclaim(&g_routing_table.vrfs[i]->v6);
+        }
+    }
+
+    while ((index = g_routing_table.nexthop_limbo) != 0) {
+        g_routing_table.nexthop_limbo = g_routing_table.nexthops[index - 1].chain;
+        g_routing_table.nexthops[index - 1].chain = g_routing_table.nexthop_free;
+        g_routing_table.nexthop_free = index;
+    }
+    g_routing_table.nexthop_limbo_count = 0;
+
+    while ((index = g_routing_table.group_limbo) != 0) {
+        g_routing_table.group_limbo = g_routing_table.groups[index - 1].chain;
+        g_routing_table.groups[index - 1].chain = g_routing_table.group_free;
+        g_routing_table.group_free = index;
+    }
+    g_routing_table.group_limbo_count = 0;
+}
+
+/**
+ * @brief Hash the forwarding behaviour of a route
+ *
+ * @param route Route information
+ * @return Next-hop hash bucket
+ */
+static uint32_t nexthop_hash(const rib_route_t *route) {
+    const uint8_t *bytes = route_addr_bytes(&route->next_hop, route->addr_type);
+    uint8_t len = (route->addr_type == IP_TYPE_V4) ? IPV4_ADDR_LEN : IPV6_ADDR_LEN;
+    uint32_t hash = 2166136261U;
+    uint8_t i;
+
+    /* FNV-1a over the next-hop address and the interface */
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ bytes[i]) * 16777619U;
+    }
+    hash = (hash ^ (route->interface_index & 0xFF)) * 16777619U;
+    hash = (hash ^ (route->interface_index >> 8)) * 16777619U;
+
+    return hash % NEXTHOP_HASH_SIZE;
+}
+
+/**
+ * @brief Check whether a next hop forwards the way a route does
+ *
+ * @param nexthop Next hop
+ * @param route Route information
+ * @return True if they match
+ */
+static bool nexthop_matches(const fib_nexthop_t *nexthop, const rib_route_t *route) {
+    return nexthop->type == route->addr_type &&
+           nexthop->interface_index == route->interface_index &&
+           memcmp(route_addr_bytes(&nexthop->next_hop, nexthop->type),
+                  route_addr_bytes(&route->next_hop, route->addr_type),
+                  (route->addr_type == IP_TYPE_V4 ? IPV4_ADDR_LEN : IPV6_ADDR_LEN)) == 0;
+}
+
+/**
+ * @brief Take a reference to the next hop of a route, creating it if needed
+ *
+ * @param route Route information
+ * @param[out] nh_index Next-hop index
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+static status_t nexthop_get(const rib_route_t *route, uint32_t *nh_index) {
+    uint32_t bucket = nexthop_hash(route);
+    fib_nexthop_t *nexthops;
+    fib_nexthop_t *nexthop;
+    uint32_t index;
+    link_event_port_info_t link;
+
+    for (index = g_routing_table.nexthop_hash[bucket]; index; index = nexthop->chain) {
+        nexthop = &g_routing_table.nexthops[index - 1];
+        if (nexthop_matches(nexthop, route)) {
+            nexthop->refcount++;
+            *nh_index = index;
+            return STATUS_SUCCESS;
+        }
+    }
+
+    if (g_routing_table.nexthop_free == 0 && g_routing_table.nexthop_limbo_count >= FIB_RECLAIM_BATCH) {
+        fib_reclaim();
+    }
+
+    if (g_routing_table.nexthop_free != 0) {
+        index = g_routing_table.nexthop_free;
+        g_routing_table.nexthop_free = g_routing_table.nexthops[index - 1].chain;
+    } else {
+        if (g_routing_table.nexthop_next == g_routing_table.nexthop_capacity) {
+            if (g_routing_table.nexthop_capacity > UINT32_MAX / 2) {
+                return STATUS_TABLE_FULL;
+            }
+
+            /* Readers may hold the old array; copy it and retire it */
+            nexthops = (fib_nexthop_t *)mem_malloc(MEM_TAG_FIB, (size_t)g_routing_table.nexthop_capacity * 2 * sizeof(fib_nexthop_t));
+            if (!nexthops) {
+                return STATUS_NO_MEMORY;
+            }
+
+            memcpy(nexthops, g_routing_table.nexthops, g_routing_table.nexthop_capacity * sizeof(fib_nexthop_t));
+            fib_retire_array(g_routing_table.nexthops, 0);
+            __atomic_store_n(&g_routing_table.nexthops, nexthops, __ATOMIC_RELEASE);
+            g_routing_table.nexthop_capacity *= 2;
+        }
+        index = ++g_routing_table.nexthop_next;
+    }
+
+    nexthop = &g_routing_table.nexthops[index - 1];
+    memset(nexthop, 0, sizeof(*nexthop));
+    memcpy((uint8_t *)route_addr_bytes(&nexthop->next_hop, route->addr_type),
+           route_addr_bytes(&route->next_hop, route->addr_type),
+           (route->addr_type == IP_TYPE_V4 ? IPV4_ADDR_LEN : IPV6_ADDR_LEN));
+    nexthop->type = route->addr_type;
+    nexthop->interface_index = route->interface_index;
+    nexthop->up = true;
+    /* A port already down holds it out until the link event that brings it up */
+    if (link_event_get_port_info(route->interface_index, &link) == STATUS_SUCCESS) {
+        nexthop->link_down = !link.delivered_up;
+    }
+    nexthop->refcount = 1;
+    nexthop->chain = g_routing_table.nexthop_hash[bucket];
+    g_routing_table.nexthop_hash[bucket] = index;
+    g_routing_table.nexthop_count++;
+
+    *nh_index = index;
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Drop a reference to a next hop, freeing it with the last one
+ *
+ * @param nh_index Next-hop index, 0 is ignored
+ */
+static void nexthop_put(uint32_t nh_index) {
+    fib_nexthop_t *nexthop;
+    uint32_t *link;
+
+    if (nh_index == 0) {
+        return;
+    }
+
+    nexthop = &g_routing_table.nexthops[nh_index - 1];
+    if (--nexthop->refcount > 0) {
+        return;
+    }
+
+    link = &g_routing_table.nexthop_hash[nexthop_hash(&(rib_route_t){
+        .next_hop = nexthop->next_hop,
+        .addr_type = nexthop->type,
+        .interface_index = nexthop->interface_index })];
+    while (*link != nh_index) {
+        link = &g_routing_table.nexthops[*link - 1].chain;
+    }
+    *link = nexthop->chain;
+
+    /* Readers may still forward through it until a grace period passes */
+    nexthop->chain = g_routing_table.nexthop_limbo;
+    g_routing_table.nexthop_limbo = nh_index;
+    g_routing_table.nexthop_limbo_count++;
+    g_routing_table.nexthop_count--;
+}
+
+/**
+ * @brief Hash the member set of a next-hop group
+ *
+ * @param members Sorted next-hop indices
+ * @param member_count Number of members
+ * @param backup Backup next-hop index, 0 if none
+ * @return Group hash bucket
+ */
+static uint32_t nhgroup_hash(const uint32_t *members, uint8_t member_count, uint32_t backup) {
+    uint32_t hash = 2166136261U;
+    uint8_t i;
+
+    for (i = 0; i < member_count; i++) {
+        hash = (hash ^ members[i]) * 16777619U;
+    }
+    hash = (hash ^ backup) * 16777619U;
+
+    return hash % NHGROUP_HASH_SIZE;
+}
+
+/**
+ * @brief Check whether a next hop can forward
+ *
+ * @param nh_index Next-hop index
+ * @return True if it is up and its port has link
+ */
+static inline bool nexthop_live(uint32_t nh_index) {
+    const fib_nexthop_t *nexthop = &g_routing_table.nexthops[nh_index - 1];
+
+    return nexthop->up && !nexthop->link_down;
+}
+
+/**
+ * @brief Spread the flow buckets of a group over its reachable members
+ *
+ * Resilient hashing: buckets of reachable members stay where they are
+ * unless the member holds more than its share, so a path going down or
+ * coming back only moves the flows that have to move.
+ *
+ * The new mapping is worked out aside and only changed buckets are stored,
+ * so readers never see a bucket without a path while others remain. With
+ * every member down, all buckets go to the backup if it can forward.
+ *
+ * @param group Next-hop group
+ */
+static void nhgroup_rebalance(fib_nhgroup_t *group) {
+    uint8_t buckets[NHGROUP_BUCKETS];
+    uint8_t load[NHGROUP_MAX_PATHS] = { 0 };
+    bool live[NHGROUP_MAX_PATHS];
+    uint8_t live_count = 0;
+    uint8_t share;
+    uint8_t slot;
+    uint8_t best;
+    uint32_t i;
+
+    for (i = 0; i < group->member_count; i++) {
+        live[i] = nexthop_live(group->members[i]);
+        live_count += live[i];
+    }
+
+    if (live_count == 0) {
+        memset(buckets, (group->backup && nexthop_live(group->backup)) ? NHGROUP_SLOT_BACKUP : NHGROUP_SLOT_NONE,
+               sizeof(buckets));
+    } else {
+        /* Keep buckets of reachable members up to their share, rounded up */
+        share = (NHGROUP_BUCKETS + live_count - 1) / live_count;
+        for (i = 0; i < NHGROUP_BUCKETS; i++) {
+            slot = group->buckets[i];
+            if (slot != NHGROUP_SLOT_NONE && slot < group->member_count && live[slot] && load[slot] < share) {
+                load[slot]++;
+                buckets[i] = slot;
+            } else {
+                buckets[i] = NHGROUP_SLOT_NONE;
+            }
+        }
+
+        /* Hand the rest to the least loaded reachable member */
+        for (i = 0; i < NHGROUP_BUCKETS; i++) {
+            if (buckets[i] != NHGROUP_SLOT_NONE) {
+                continue;
+            }
+
+            best = NHGROUP_SLOT_NONE;
+            for (slot = 0; slot < group->member_count; slot++) {
+                if (live[slot] && (best == NHGROUP_SLOT_NONE || load[slot] < load[best])) {
+                    best = slot;
+                }
+            }
+
+            buckets[i] = best;
+            load[best]++;
+        }
+    }
+
+    for (i = 0; i < NHGROUP_BUCKETS; i++) {
+        if (group->buckets[i] != buckets[i]) {
+            __atomic_store_n(&group->buckets[i], buckets[i], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/**
+ * @brief Take a reference to the group of a next-hop set, creating it if needed
+ *
+ * Consumes one reference to each member next hop and to the backup.
+ *
+ * @param members Sorted next-hop indices
+ * @param member_count Number of members, at least one
+ * @param backup Next hop taking over when every member is down, 0 if none
+ * @param[out] group_index Next-hop group index
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+static status_t nhgroup_get(const uint32_t *members, uint8_t member_count, uint32_t backup,
+                            uint32_t *group_index) {
+    uint32_t bucket = nhgroup_hash(members, member_count, backup);
+    fib_nhgroup_t *groups;
+    fib_nhgroup_t *group;
+    uint32_t index;
+    uint8_t i;
+
+    for (index = g_routing_table.group_hash[bucket]; index; index = group->chain) {
+        group = &g_routing_table.groups[index - 1];
+        if (group->member_count == member_count && group->backup == backup &&
+            memcmp(group->members, members, member_count * sizeof(uint32_t)) == 0) {
+            /* The group already holds the member references */
+            for (i = 0; i < member_count; i++) {
+                nexthop_put(members[i]);
+            }
+            nexthop_put(backup);
+            group->refcount++;
+            *group_index = index;
+            return STATUS_SUCCESS;
+        }
+    }
+
+    if (g_routing_table.group_free == 0 && g_routing_table.group_limbo_count >= FIB_RECLAIM_BATCH) {
+        fib_reclaim();
+    }
+
+    if (g_routing_table.group_free != 0) {
+        index = g_routing_table.group_free;
+        g_routing_table.group_free = g_routing_table.groups[index - 1].chain;
+    } else {
+        if (g_routing_table.group_next == g_routing_table.group_capacity) {
+            if (g_routing_table.group_capacity > UINT32_MAX / 2) {
+                return STATUS_TABLE_FULL;
+            }
+
+            /* Readers may hold the old array; copy it and retire it */
+            groups = (fib_nhgroup_t *)mem_malloc(MEM_TAG_FIB, (size_t)g_routing_table.group_capacity * 2 * sizeof(fib_nhgroup_t));
+            if (!groups) {
+                return STATUS_NO_MEMORY;
+            }
+
+            memcpy(groups, g_routing_table.groups, g_routing_table.group_capacity * sizeof(fib_nhgroup_t));
+            fib_retire_array(g_routing_table.groups, 0);
+            __atomic_store_n(&g_routing_table.groups, groups, __ATOMIC_RELEASE);
+            g_routing_table.group_capacity *= 2;
+        }
+        /* Published after the array that holds it, for routing_nexthop_select() */
+        index = g_routing_table.group_next + 1;
+        __atomic_store_n(&g_routing_table.group_next, index, __ATOMIC_RELEASE);
+    }
+
+    group = &g_routing_table.groups[index - 1];
+    memset(group, 0, sizeof(*group));
+    memcpy(group->members, members, member_count * sizeof(uint32_t));
+    group->member_count = member_count;
+    group->backup = backup;
+    memset(group->buckets, NHGROUP_SLOT_NONE, sizeof(group->buckets));
+    nhgroup_rebalance(group);
+    group->refcount = 1;
+    group->chain = g_routing_table.group_hash[bucket];
+    g_routing_table.group_hash[bucket] = index;
+    g_routing_table.group_count++;
+
+    *group_index = index;
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Drop a reference to a next-hop group, freeing it with the last one
+ *
+ * @param group_index Next-hop group index, 0 is ignored
+ */
+static void nhgroup_put(uint32_t group_index) {
+    fib_nhgroup_t *group;
+    uint32_t *link;
+    uint8_t i;
+
+    if (group_index == 0) {
+        return;
+    }
+
+    group = &g_routing_table.groups[group_index - 1];
+    if (--group->refcount > 0) {
+        return;
+    }
+
+    link = &g_routing_table.group_hash[nhgroup_hash(group->members, group->member_count, group->backup)];
+    while (*link != group_index) {
+        link = &g_routing_table.groups[*link - 1].chain;
+    }
+    *link = group->chain;
+
+    for (i = 0; i < group->member_count; i++) {
+        nexthop_put(group->members[i]);
+    }
+    nexthop_put(group->backup);
+
+    /* Readers may still forward through it until a grace period passes */
+    group->chain = g_routing_table.group_limbo;
+    g_routing_table.group_limbo = group_index;
+    g_routing_table.group_limbo_count++;
+    g_routing_table.group_count--;
+}
+
+/**
+ * @brief Pick the path of a next-hop group for a flow
+ *
+ * Lock-free; must be called inside an RCU read section.
+ *
+ * @param group_index Next-hop group index
+ * @param flow_hash Flow hash from routing_flow_hash()
+ * @param[out] next_hop Next hop address
+ * @param[out] interface_index Egress interface
+ * @return STATUS_SUCCESS, or STATUS_NOT_FOUND if every path is down
+ */
+static status_t nhgroup_select(uint32_t group_index, uint32_t flow_hash,
+                               ip_addr_t *next_hop, uint16_t *interface_index) {
+    const fib_nhgroup_t *group;
+    const fib_nexthop_t *nexthop;
+    uint32_t nh_index;
+    uint8_t slot;
+
+    group = &__atomic_load_n(&g_routing_table.groups, __ATOMIC_ACQUIRE)[group_index - 1];
+    slot = __atomic_load_n(&group->buckets[flow_hash % NHGROUP_BUCKETS], __ATOMIC_RELAXED);
+    if (slot == NHGROUP_SLOT_NONE) {
+        return STATUS_NOT_FOUND;
+    }
+
+    nh_index = (slot == NHGROUP_SLOT_BACKUP) ? group->backup : group->members[slot];
+    nexthop = &__atomic_load_n(&g_routing_table.nexthops, __ATOMIC_ACQUIRE)[nh_index - 1];
+    memcpy(next_hop, &nexthop->next_hop, sizeof(ip_addr_t));
+    *interface_index = nexthop->interface_index;
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Take a reference to the next-hop group of a prefix
+ *
+ * The group has one member per distinct next hop among the best candidate
+ * and the candidates of equal administrative distance and metric. The first
+ * loop-free alternate among them that is not a member becomes the backup.
+ *
+ * @param best Best candidate of the prefix
+ * @param[out] group_index Next-hop group index
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+static status_t fib_prefix_group(const rib_entry_t *best, uint32_t *group_index) {
+    uint32_t members[NHGROUP_MAX_PATHS];
+    const rib_entry_t *candidate;
+    uint8_t member_count = 0;
+    uint32_t backup = 0;
+    uint32_t nh_index;
+    uint8_t i, j;
+    status_t status;
+
+    /* Candidates are ordered, so the equal-cost ones directly follow the best */
+    for (candidate = best; candidate && member_count < NHGROUP_MAX_PATHS && !route_preferred(best, candidate) &&
+         candidate->leak_vrf == ROUTE_VRF_NONE;
+         candidate = candidate->alt) {
+        status = nexthop_get(&candidate->info, &nh_index);
+        if (status != STATUS_SUCCESS) {
+            for (i = 0; i < member_count; i++) {
+                nexthop_put(members[i]);
+            }
+            return status;
+        }
+
+        /* Insert in order, dropping duplicates */
+        for (i = 0; i < member_count && members[i] < nh_index; i++) {
+        }
+        if (i < member_count && members[i] == nh_index) {
+            nexthop_put(nh_index);
+            continue;
+        }
+        for (j = member_count; j > i; j--) {
+            members[j] = members[j - 1];
+        }
+        members[i] = nh_index;
+        member_count++;
+    }
+
+    for (candidate = best; candidate && backup == 0 && !route_preferred(best, candidate) &&
+         candidate->leak_vrf == ROUTE_VRF_NONE;
+         candidate = candidate->alt) {
+        backup = candidate->backup_nh;
+        for (i = 0; i < member_count && backup != 0; i++) {
+            if (members[i] == backup) {
+                backup = 0;
+            }
+        }
+    }
+    if (backup != 0) {
+        g_routing_table.nexthops[backup - 1].refcount++;
+    }
+
+    return nhgroup_get(members, member_count, backup, group_index);
+}
+
+/**
+ * @brief Get the route a leaked candidate forwards along
+ *
+ * Leaked candidates are never leaked on, so only routes of the source
+ * VRF's own count.
+ *
+ * @param leak Leaked candidate
+ * @return Installed candidate of the prefix in the source VRF, NULL if none
+ */
+static rib_entry_t *fib_leak_target(const rib_entry_t *leak) {
+    rib_entry_t *candidate;
+
+    for (candidate = find_route_exact(leak->leak_vrf, &leak->info.prefix, leak->info.prefix_len,
+                                      leak->info.addr_type);
+         candidate; candidate = candidate->alt) {
+        if (candidate->leak_vrf == ROUTE_VRF_NONE && candidate->group_index != 0) {
+            return candidate;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Get the FIB leaf of a prefix's candidate
+ *
+ * @param entry Candidate
+ * @return Leaf naming the entry readers reach, LPM_LEAF_NONE if not installed
+ */
+static uint32_t fib_leaf_of(const rib_entry_t *entry) {
+    if (entry->group_index == 0) {
+        return LPM_LEAF_NONE;
+    }
+
+    /* An installed leak holds the index of the source route it shares */
+    if (entry->leak_vrf != ROUTE_VRF_NONE) {
+        return lpm_leaf(entry->info.prefix_len, entry->group_index);
+    }
+
+    return lpm_leaf(entry->info.prefix_len, entry->index);
+}
+
+/*
+ * FIB compression (CONFIG_FIB_COMPRESS). A node whose entries are all
+ * leaves of the VRF's own routes through one next-hop group forwards every
+ * address the same way, so it is folded into its parent entry as a single
+ * leaf naming the first of those routes, with LPM_DEPTH_FOLDED as its
+ * prefix length. Lookups stop a level earlier and may return an
+ * equivalent route instead of the longest match; the RIB keeps every route.
+ *
+ * Only nodes of plain leaves are folded, so a folded entry always stands
+ * for one node of prefixes no longer than the level below it, and that
+ * node can be rebuilt from the RIB. Before a prefix is written the folded
+ * entries on its path and in its range are rebuilt, so lpm_trie_insert()
+ * and lpm_trie_replace() never see one, and afterwards the nodes the prefix
+ * touched are folded again where they can be.
+ */
+
+/**
+ * @brief Add a prefix to a VRF's trie
+ *
+ * @param vrf_id VRF of the prefix
+ * @param prefix Masked IP address prefix
+ * @param depth Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ * @param leaf Leaf of the prefix
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+static status_t fib_trie_insert(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t depth,
+                                ip_addr_type_t type, uint32_t leaf);
+
+/**
+ * @brief Replace the leaves of a prefix in a VRF's trie
+ *
+ * @param vrf_id VRF of the prefix
+ * @param prefix Masked IP address prefix
+ * @param depth Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ * @param leaf Leaf taking over, LPM_LEAF_NONE to clear
+ */
+static void fib_trie_replace(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t depth,
+                             ip_addr_type_t type, uint32_t leaf);
+
+#if CONFIG_FIB_COMPRESS
+
+/**
+ * @brief Point the address bytes at one entry of a trie level
+ *
+ * @param trie Trie
+ * @param bytes Address bytes in network order
+ * @param level_end Prefix length the level's entries cover
+ * @param index Table index
+ */
+static void fib_compress_set_index(const lpm_trie_t *trie, uint8_t *bytes, uint8_t level_end,
+                                   uint32_t index) {
+    uint8_t root_bytes = trie->root_bits / 8;
+    uint8_t i;
+
+    if (level_end > trie->root_bits) {
+        bytes[level_end / 8 - 1] = (uint8_t)index;
+        return;
+    }
+    for (i = 0; i < root_bytes; i++) {
+        bytes[root_bytes - 1 - i] = (uint8_t)(index >> (8 * i));
+    }
+}
+
+/**
+ * @brief Get the leaf an installed prefix has in the FIB
+ *
+ * @param vrf_id VRF of the prefix
+ * @param addr Address whose first prefix_len bits are the prefix
+ * @param prefix_len Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ * @return Leaf of the prefix, LPM_LEAF_NONE if it is not installed
+ */
+static uint32_t fib_compress_probe(uint16_t vrf_id, const ip_addr_t *addr, uint8_t prefix_len,
+                                   ip_addr_type_t type) {
+    const rib_entry_t *candidate;
+    ip_addr_t prefix = *addr;
+
+    mask_prefix(&prefix, prefix_len, type);
+    for (candidate = find_route_exact(vrf_id, &prefix, prefix_len, type); candidate;
+         candidate = candidate->alt) {
+        if (candidate->group_index != 0) {
+            return fib_leaf_of(candidate);
+        }
+    }
+
+    return LPM_LEAF_NONE;
+}
+
+/**
+ * @brief Rebuild the node a folded entry stands for
+ *
+ * Each entry of the node gets the longest installed prefix covering it.
+ * Without memory for the node, the entry is left with the prefix covering
+ * all of it, which loses the longer ones but never names a route that is
+ * gone.
+ *
+ * @param vrf_id VRF of the trie
+ * @param type IP address type (IPv4 or IPv6)
+ * @param node_id Node holding the folded entry
+ * @param index Index of the entry
+ * @param addr Address inside the entry
+ * @param level_end Prefix length the entry covers
+ */
+static void fib_unfold_entry(uint16_t vrf_id, ip_addr_type_t type, uint32_t node_id, uint32_t index,
+                             const ip_addr_t *addr, uint8_t level_end) {
+    lpm_trie_t *trie = fib_trie(vrf_id, type);
+    const rib_entry_t *covering;
+    ip_addr_t probe = *addr;
+    uint8_t *bytes = (uint8_t *)route_addr_bytes(&probe, type);
+    uint32_t *table;
+    uint32_t child;
+    uint32_t first;
+    uint32_t span;
+    uint32_t leaf;
+    uint32_t i;
+    uint8_t len;
+
+    mask_prefix(&probe, level_end, type);
+    covering = find_route_covering(vrf_id, &probe, level_end + 1, type);
+    leaf = covering ? fib_leaf_of(covering) : LPM_LEAF_NONE;
+
+    trie->folded_count--;
+    if (lpm_alloc_node(trie, leaf, &child) != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "No memory to expand a compressed FIB node");
+        lpm_entry_store(&lpm_table(trie, node_id)[index], leaf);
+        return;
+    }
+
+    /* Shorter prefixes first, so the longest one covering an entry stays */
+    table = lpm_table(trie, child);
+    for (len = level_end + 1; len <= level_end + LPM_STRIDE_BITS; len++) {
+        span = 1U << (level_end + LPM_STRIDE_BITS - len);
+        for (first = 0; first < LPM_NODE_SIZE; first += span) {
+            bytes[level_end / 8] = (uint8_t)first;
+            leaf = fib_compress_probe(vrf_id, &probe, len, type);
+            if (leaf == LPM_LEAF_NONE) {
+                continue;
+            }
+            for (i = first; i < first + span; i++) {
+                table[i] = leaf;
+            }
+        }
+    }
+
+    lpm_entry_store(&lpm_table(trie, node_id)[index], LPM_ENTRY_EXT | child);
+}
+
+/**
+ * @brief Rebuild the folded entries in a range of a node and below it
+ *
+ * @param vrf_id VRF of the trie
+ * @param type IP address type (IPv4 or IPv6)
+ * @param node_id Node number or LPM_NODE_ROOT
+ * @param first First entry of the range
+ * @param count Number of entries
+ * @param addr Address inside the node, overwritten
+ * @param level_end Prefix length the node's entries cover
+ */
+static void fib_unfold_table(uint16_t vrf_id, ip_addr_type_t type, uint32_t node_id, uint32_t first,
+                             uint32_t count, ip_addr_t *addr, uint8_t level_end) {
+    lpm_trie_t *trie = fib_trie(vrf_id, type);
+    uint8_t *bytes = (uint8_t *)route_addr_bytes(addr, type);
+    uint32_t entry;
+    uint32_t i;
+
+    for (i = first; i < first + count && trie->folded_count > 0; i++) {
+        entry = lpm_table(trie, node_id)[i];
+        if (!(entry & LPM_ENTRY_EXT) && lpm_leaf_depth(entry) != LPM_DEPTH_FOLDED) {
+            continue;
+        }
+
+        fib_compress_set_index(trie, bytes, level_end, i);
+        if (!(entry & LPM_ENTRY_EXT)) {
+            fib_unfold_entry(vrf_id, type, node_id, i, addr, level_end);
+            entry = lpm_table(trie, node_id)[i];
+        }
+        if (entry & LPM_ENTRY_EXT) {
+            fib_unfold_table(vrf_id, type, entry & LPM_NODE_MASK, 0, LPM_NODE_SIZE, addr,
+                             level_end + LPM_STRIDE_BITS);
+        }
+    }
+}
+
+/**
+ * @brief Rebuild the folded entries a prefix update may write
+ *
+ * Those are the entries on the prefix's path and the ones in its range.
+ *
+ * @param vrf_id VRF of the prefix
+ * @param prefix Masked IP address prefix
+ * @param depth Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ */
+static void fib_unfold_prefix(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t depth,
+                              ip_addr_type_t type) {
+    lpm_trie_t *trie = fib_trie(vrf_id, type);
+    const uint8_t *bytes = route_addr_bytes(prefix, type);
+    uint32_t node_id = LPM_NODE_ROOT;
+    uint8_t level_end = trie->root_bits;
+    ip_addr_t addr = *prefix;
+    uint32_t entry;
+    uint32_t index;
+    uint32_t span;
+    uint8_t level;
+
+    for (level = 0; trie->folded_count > 0; level++) {
+        index = lpm_level_index(trie, bytes, level);
+
+        if (depth <= level_end) {
+            span = 1U << (level_end - depth);
+            fib_unfold_table(vrf_id, type, node_id, index & ~(span - 1), span, &addr, level_end);
+            return;
+        }
+
+        entry = lpm_table(trie, node_id)[index];
+        if (!(entry & LPM_ENTRY_EXT) && lpm_leaf_depth(entry) == LPM_DEPTH_FOLDED) {
+            fib_unfold_entry(vrf_id, type, node_id, index, prefix, level_end);
+            entry = lpm_table(trie, node_id)[index];
+        }
+        if (!(entry & LPM_ENTRY_EXT)) {
+            return;
+        }
+
+        node_id = entry & LPM_NODE_MASK;
+        level_end += LPM_STRIDE_BITS;
+    }
+}
+
+/**
+ * @brief Fold a child node into its parent entry if it can be
+ *
+ * @param vrf_id VRF of the trie
+ * @param type IP address type (IPv4 or IPv6)
+ * @param node_id Node holding the entry
+ * @param index Index of the entry
+ */
+static void fib_fold_node(uint16_t vrf_id, ip_addr_type_t type, uint32_t node_id, uint32_t index) {
+    lpm_trie_t *trie = fib_trie(vrf_id, type);
+    uint32_t entry = lpm_table(trie, node_id)[index];
+    const rib_entry_t *route;
+    const uint32_t *table;
+    uint32_t group_index = 0;
+    bool same = true;
+    uint32_t i;
+
+    if (!(entry & LPM_ENTRY_EXT)) {
+        return;
+    }
+
+    /* Leaks name routes of other VRFs, whose groups change without this trie knowing */
+    table = lpm_table(trie, entry & LPM_NODE_MASK);
+    for (i = 0; i < LPM_NODE_SIZE; i++) {
+        if ((table[i] & LPM_ENTRY_EXT) || table[i] == LPM_LEAF_NONE ||
+            lpm_leaf_depth(table[i]) == LPM_DEPTH_FOLDED) {
+            return;
+        }
+        route = rib_entry_at(g_routing_table.chunks, table[i]);
+        if (route->vrf_id != vrf_id || route->leak_vrf != ROUTE_VRF_NONE || route->group_index == 0 ||
+            (i > 0 && route->group_index != group_index)) {
+            return;
+        }
+        group_index = route->group_index;
+        same = same && table[i] == table[0];
+    }
+
+    if (same) {
+        /* Not a fold: the node only repeats the entry */
+        lpm_entry_store(&lpm_table(trie, node_id)[index], table[0]);
+    } else {
+        lpm_entry_store(&lpm_table(trie, node_id)[index],
+                        lpm_leaf(LPM_DEPTH_FOLDED, table[0] & LPM_ROUTE_MASK));
+        trie->folded_count++;
+    }
+    lpm_free_node(trie, entry & LPM_NODE_MASK);
+}
+
+/**
+ * @brief Fold the foldable nodes below a range of a node
+ *
+ * @param vrf_id VRF of the trie
+ * @param type IP address type (IPv4 or IPv6)
+ * @param node_id Node number or LPM_NODE_ROOT
+ * @param first First entry of the range
+ * @param count Number of entries
+ */
+static void fib_fold_table(uint16_t vrf_id, ip_addr_type_t type, uint32_t node_id, uint32_t first,
+                           uint32_t count) {
+    lpm_trie_t *trie = fib_trie(vrf_id, type);
+    uint32_t entry;
+    uint32_t i;
+
+    for (i = first; i < first + count; i++) {
+        entry = lpm_table(trie, node_id)[i];
+        if (entry & LPM_ENTRY_EXT) {
+            fib_fold_table(vrf_id, type, entry & LPM_NODE_MASK, 0, LPM_NODE_SIZE);
+            fib_fold_node(vrf_id, type, node_id, i);
+        }
+    }
+}
+
+/**
+ * @brief Fold the nodes a prefix update touched where they can be
+ *
+ * Those are the nodes in the prefix's range and the last node on its path.
+ *
+ * @param vrf_id VRF of the prefix
+ * @param prefix Masked IP address prefix
+ * @param depth Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ */
+static void fib_fold_prefix(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t depth,
+                            ip_addr_type_t type) {
+    lpm_trie_t *trie = fib_trie(vrf_id, type);
+    const uint8_t *bytes = route_addr_bytes(prefix, type);
+    uint32_t parent_node = LPM_NODE_ROOT;
+    uint32_t parent_index = 0;
+    uint32_t node_id = LPM_NODE_ROOT;
+    uint8_t level_end = trie->root_bits;
+    uint32_t entry;
+    uint32_t index;
+    uint32_t span;
+    uint8_t level;
+
+    for (level = 0; ; level++) {
+        index = lpm_level_index(trie, bytes, level);
+
+        if (depth <= level_end) {
+            span = 1U << (level_end - depth);
+            fib_fold_table(vrf_id, type, node_id, index & ~(span - 1), span);
+            break;
+        }
+
+        entry = lpm_table(trie, node_id)[index];
+        if (!(entry & LPM_ENTRY_EXT)) {
+            break;
+        }
+
+        parent_node = node_id;
+        parent_index = index;
+        node_id = entry & LPM_NODE_MASK;
+        level_end += LPM_STRIDE_BITS;
+    }
+
+    if (level > 0) {
+        fib_fold_node(vrf_id, type, parent_node, parent_index);
+    }
+}
+
+#endif /* CONFIG_FIB_COMPRESS */
+
+static status_t fib_trie_insert(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t depth,
+                                ip_addr_type_t type, uint32_t leaf) {
+    status_t status;
+
+#if CONFIG_FIB_COMPRESS
+    fib_unfold_prefix(vrf_id, prefix, depth, type);
+#endif
+    status = lpm_trie_insert(fib_trie(vrf_id, type), route_addr_bytes(prefix, type), depth, leaf);
+#if CONFIG_FIB_COMPRESS
+    if (status != STATUS_SUCCESS) {
+        /* A rebuilt node may already hold the prefix the caller gives up on */
+        const rib_entry_t *covering = find_route_covering(vrf_id, prefix, depth, type);
+
+        lpm_trie_replace(fib_trie(vrf_id, type), route_addr_bytes(prefix, type), depth,
+                         covering ? fib_leaf_of(covering) : LPM_LEAF_NONE);
+    }
+    fib_fold_prefix(vrf_id, prefix, depth, type);
+#endif
+
+    return status;
+}
+
+static void fib_trie_replace(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t depth,
+                             ip_addr_type_t type, uint32_t leaf) {
+#if CONFIG_FIB_COMPRESS
+    fib_unfold_prefix(vrf_id, prefix, depth, type);
+#endif
+    lpm_trie_replace(fib_trie(vrf_id, type), route_addr_bytes(prefix, type), depth, leaf);
+#if CONFIG_FIB_COMPRESS
+    fib_fold_prefix(vrf_id, prefix, depth, type);
+#endif
+}
+
+/**
+ * @brief Refold the FIB around a prefix whose next-hop group changed in place
+ *
+ * Folded entries naming routes of the old group may no longer all forward
+ * the same way.
+ *
+ * @param entry Installed candidate of the prefix
+ */
+static void fib_trie_regroup(const rib_entry_t *entry) {
+#if CONFIG_FIB_COMPRESS
+    fib_unfold_prefix(entry->vrf_id, &entry->info.prefix, entry->info.prefix_len, entry->info.addr_type);
+    fib_fold_prefix(entry->vrf_id, &entry->info.prefix, entry->info.prefix_len, entry->info.addr_type);
+#else
+    (void)entry;
+#endif
+}
+
+/**
+ * @brief Point the leaks of a prefix at its newly installed route
+ *
+ * Called while the previously installed route is still readable, so
+ * readers that reach it through a leak never find it withdrawn for good.
+ *
+ * @param route Candidate of the source VRF's prefix
+ * @param target Route installed for the prefix now, NULL if none
+ */
+static void fib_leaks_follow(const rib_entry_t *route, const rib_entry_t *target) {
+    const uint8_t *bytes = route_addr_bytes(&route->info.prefix, route->info.addr_type);
+    uint8_t depth = route->info.prefix_len;
+    rib_entry_t *leak;
+
+    for (leak = g_routing_table.leaks; leak; leak = leak->leak_next) {
+        if (leak->leak_vrf != route->vrf_id || leak->info.addr_type != route->info.addr_type ||
+            leak->info.prefix_len != depth ||
+            memcmp(route_addr_bytes(&leak->info.prefix, leak->info.addr_type), bytes,
+                   (route->info.addr_type == IP_TYPE_V4 ? IPV4_ADDR_LEN : IPV6_ADDR_LEN)) != 0) {
+            continue;
+        }
+
+        if (leak->group_index != 0) {
+            if (!target) {
+                fib_withdraw(leak);
+                continue;
+            }
+            fib_trie_replace(leak->vrf_id, &leak->info.prefix, depth, leak->info.addr_type,
+                             lpm_leaf(depth, target->index));
+            leak->group_index = target->index;
+        } else if (target && leak->batch_slot == 0 &&
+                   find_route_exact(leak->vrf_id, &leak->info.prefix, depth, leak->info.addr_type) == leak) {
+            /* The leak is the best the VRF has; a batch commit installs it otherwise */
+            if (fib_trie_insert(leak->vrf_id, &leak->info.prefix, depth, leak->info.addr_type,
+                                lpm_leaf(depth, target->index)) == STATUS_SUCCESS) {
+                leak->group_index = target->index;
+            } else {
+                LOG_ERROR(LOG_CATEGORY_L3, "No memory to install leaked route");
+            }
+        }
+    }
+}
+
+/**
+ * @brief Report a FIB change of a prefix to the event feed
+ *
+ * @param entry Candidate of the prefix
+ * @param kind EVENT_FEED_ROUTE_ADD, EVENT_FEED_ROUTE_DELETE or EVENT_FEED_ROUTE_CHANGE
+ */
+static inline void fib_post_event(const rib_entry_t *entry, event_feed_kind_t kind) {
+    if (event_feed_enabled(kind)) {
+        event_feed_post_route(kind, entry->vrf_id,
+                              route_addr_bytes(&entry->info.prefix, entry->info.addr_type),
+                              entry->info.prefix_len, entry->info.addr_type == IP_TYPE_V6);
+    }
+}
+
+/**
+ * @brief Install the best candidate of a new prefix in the FIB
+ *
+ * A leaked candidate is installed only while its source VRF has a route
+ * for the prefix.
+ *
+ * @param best Best candidate
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+static status_t fib_install(rib_entry_t *best) {
+    uint8_t depth = best->info.prefix_len;
+    const rib_entry_t *target;
+    uint32_t group_index;
+    status_t status;
+
+    if (best->leak_vrf != ROUTE_VRF_NONE) {
+        target = fib_leak_target(best);
+        if (!target) {
+            return STATUS_SUCCESS;
+        }
+
+        status = fib_trie_insert(best->vrf_id, &best->info.prefix, depth, best->info.addr_type,
+                                 lpm_leaf(depth, target->index));
+        if (status == STATUS_SUCCESS) {
+            best->group_index = target->index;
+            fib_changed();
+            fib_post_event(best, EVENT_FEED_ROUTE_ADD);
+        }
+        return status;
+    }
+
+    status = fib_prefix_group(best, &group_index);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    /* The group must be visible before any leaf naming the entry */
+    __atomic_store_n(&best->group_index, group_index, __ATOMIC_RELEASE);
+
+    status = fib_trie_insert(best->vrf_id, &best->info.prefix, depth, best->info.addr_type,
+                             lpm_leaf(depth, best->index));
+    if (status != STATUS_SUCCESS) {
+        __atomic_store_n(&best->group_index, 0, __ATOMIC_RELEASE);
+        nhgroup_put(group_index);
+        return status;
+    }
+
+    if (g_routing_table.leaks) {
+        fib_leaks_follow(best, best);
+    }
+    fib_changed();
+    fib_post_event(best, EVENT_FEED_ROUTE_ADD);
+
+    if (g_routing_table.hw_sync_enabled) {
+        sync_route_to_hw(best, HW_OPERATION_ADD);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Withdraw a prefix from the FIB
+ *
+ * Its entries fall back to the longest covering prefix still in the RIB,
+ * and prefixes leaked from it are withdrawn from their VRFs.
+ *
+ * @param best Installed best candidate of the prefix
+ */
+static void fib_withdraw(rib_entry_t *best) {
+    rib_entry_t *covering;
+    uint32_t leaf = LPM_LEAF_NONE;
+
+    if (best->group_index == 0) {
+        return;
+    }
+
+    covering = find_route_covering(best->vrf_id, &best->info.prefix, best->info.prefix_len,
+                                   best->info.addr_type);
+    if (covering) {
+        leaf = fib_leaf_of(covering);
+    }
+
+    fib_trie_replace(best->vrf_id, &best->info.prefix, best->info.prefix_len, best->info.addr_type,
+                     leaf);
+
+    if (best->leak_vrf != ROUTE_VRF_NONE) {
+        best->group_index = 0;
+        fib_changed();
+        fib_post_event(best, EVENT_FEED_ROUTE_DELETE);
+        return;
+    }
+
+    if (g_routing_table.leaks) {
+        fib_leaks_follow(best, NULL);
+    }
+
+    /* Readers that still reach the entry see it withdrawn and look again */
+    nhgroup_put(best->group_index);
+    __atomic_store_n(&best->group_index, 0, __ATOMIC_RELEASE);
+    fib_changed();
+    fib_post_event(best, EVENT_FEED_ROUTE_DELETE);
+
+    if (g_routing_table.hw_sync_enabled) {
+        sync_route_to_hw(best, HW_OPERATION_DELETE);
+    }
+}
+
+/**
+ * @brief Reinstall a leaked candidate that took over a prefix
+ *
+ * @param old_best Other candidate currently installed
+ * @param new_best Leaked candidate, best now
+ */
+static void fib_refresh_leak(rib_entry_t *old_best, rib_entry_t *new_best) {
+    uint8_t depth = new_best->info.prefix_len;
+    uint32_t old_group = old_best->group_index;
+    const rib_entry_t *target = fib_leak_target(new_best);
+
+    if (!target) {
+        fib_withdraw(old_best);
+        return;
+    }
+
+    new_best->group_index = target->index;
+    fib_trie_replace(new_best->vrf_id, &new_best->info.prefix, depth, new_best->info.addr_type,
+                     lpm_leaf(depth, target->index));
+
+    if (old_best->leak_vrf != ROUTE_VRF_NONE) {
+        old_best->group_index = 0;
+        return;
+    }
+
+    /* The VRF's own route is gone, so prefixes leaked from it go too */
+    if (g_routing_table.leaks) {
+        fib_leaks_follow(old_best, NULL);
+    }
+    __atomic_store_n(&old_best->group_index, 0, __ATOMIC_RELEASE);
+    nhgroup_put(old_group);
+
+    if (g_routing_table.hw_sync_enabled) {
+        sync_route_to_hw(old_best, HW_OPERATION_DELETE);
+    }
+}
+
+/**
+ * @brief Reinstall a prefix after its candidates changed
+ *
+ * Rebuilds the next-hop group from the new best candidate and its
+ * equal-cost peers. The new best may be the old one.
+ *
+ * @param old_best Candidate currently installed
+ * @param new_best Best candidate now
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+static status_t fib_refresh(rib_entry_t *old_best, rib_entry_t *new_best) {
+    uint8_t depth = new_best->info.prefix_len;
+    uint32_t old_group = old_best->group_index;
+    uint32_t group_index;
+    status_t status;
+
+    if (old_group == 0) {
+        return fib_install(new_best);
+    }
+
+    if (new_best->leak_vrf != ROUTE_VRF_NONE) {
+        /* A leak's own changes arrive through fib_leaks_follow() */
+        if (old_best != new_best) {
+            fib_refresh_leak(old_best, new_best);
+            fib_changed();
+            if (new_best->group_index != 0) {
+                fib_post_event(new_best, EVENT_FEED_ROUTE_CHANGE);
+            }
+        }
+        return STATUS_SUCCESS;
+    }
+
+    status = fib_prefix_group(new_best, &group_index);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    /* Publish the group first; the leaf only changes with the entry */
+    __atomic_store_n(&new_best->group_index, group_index, __ATOMIC_RELEASE);
+    if (old_best == new_best) {
+        nhgroup_put(old_group);
+        fib_trie_regroup(new_best);
+        fib_changed();
+        fib_post_event(new_best, EVENT_FEED_ROUTE_CHANGE);
+        return STATUS_SUCCESS;
+    }
+
+    fib_trie_replace(new_best->vrf_id, &new_best->info.prefix, depth, new_best->info.addr_type,
+                     lpm_leaf(depth, new_best->index));
+    if (g_routing_table.leaks) {
+        fib_leaks_follow(new_best, new_best);
+    }
+
+    if (old_best->leak_vrf != ROUTE_VRF_NONE) {
+        /* A leak held no group; the VRF's own route replaces it */
+        old_best->group_index = 0;
+    } else {
+        __atomic_store_n(&old_best->group_index, 0, __ATOMIC_RELEASE);
+        nhgroup_put(old_group);
+    }
+    fib_changed();
+    fib_post_event(new_best, EVENT_FEED_ROUTE_CHANGE);
+
+    if (g_routing_table.hw_sync_enabled) {
+        sync_route_to_hw(old_best, HW_OPERATION_DELETE);
+        sync_route_to_hw(new_best, HW_OPERATION_ADD);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Report the memory held by the RIB and the FIB
+ *
+ * @param[out] stats Statistics to fill in
+ */
+static void fib_get_memory_stats(routing_table_stats_t *stats) {
+    uint32_t i;
+
+    stats->rib_memory = (uint64_t)g_routing_table.capacity * sizeof(rib_entry_t) +
+                        (uint64_t)g_routing_table.hash_size * sizeof(rib_entry_t *);
+    stats->ipv4_fib_memory = 0;
+    stats->ipv6_lpm_memory = 0;
+    stats->ipv6_lpm_nodes = 0;
+    stats->fib_nodes = 0;
+    stats->fib_folded_nodes = 0;
+    for (i = 0; i < ROUTING_MAX_VRFS; i++) {
+        if (g_routing_table.vrfs[i]) {
+            stats->ipv4_fib_memory += lpm_trie_memory(&g_routing_table.vrfs[i]->v4);
+            stats->ipv6_lpm_memory += lpm_trie_memory(&g_routing_table.vrfs[i]->v6);
+            stats->ipv6_lpm_nodes += g_routing_table.vrfs[i]->v6.node_count;
+            stats->fib_nodes += g_routing_table.vrfs[i]->v4.node_count + g_routing_table.vrfs[i]->v6.node_count;
+            stats->fib_folded_nodes += g_routing_table.vrfs[i]->v4.folded_count +
+                                       g_routing_table.vrfs[i]->v6.folded_count;
+        }
+    }
+    stats->fib_prefixes = g_routing_table.prefix_count;
+    stats->fib_nexthops = g_routing_table.nexthop_count;
+    stats->fib_nhgroups = g_routing_table.group_count;
+    stats->nexthop_link_changes = g_routing_table.nexthop_link_changes;
+}
+
+
+
+/* --- RIB OPERATIONS ------------------------------------------------------- */
+
+/**
+ * @brief Get the administrative distance of a route source
+ *
+ * @param source Route source
+ * @return Administrative distance, lower is preferred
+ */
+static uint8_t route_admin_distance(route_source_t source) {
+    switch ((route_type_t)source) {
+        case ROUTE_TYPE_CONNECTED:
+            return ADMIN_DISTANCE_CONNECTED;
+        case ROUTE_TYPE_STATIC:
+            return ADMIN_DISTANCE_STATIC;
+        case ROUTE_TYPE_BGP:
+            return ADMIN_DISTANCE_BGP_EXTERNAL;
+        case ROUTE_TYPE_OSPF:
+            return ADMIN_DISTANCE_OSPF;
+        case ROUTE_TYPE_RIP:
+            return ADMIN_DISTANCE_RIP;
+        default:
+            return ROUTE_ADMIN_DISTANCE_UNKNOWN;
+    }
+}
+
+/**
+ * @brief Check whether one candidate is preferred over another
+ *
+ * @param a Candidate
+ * @param b Candidate
+ * @return True if a has a lower administrative distance, or the same one
+ *         and a lower metric
+ */
+static inline bool route_preferred(const rib_entry_t *a, const rib_entry_t *b) {
+    return a->admin_distance < b->admin_distance ||
+           (a->admin_distance == b->admin_distance && a->info.metric < b->info.metric);
+}
+
+/**
+ * @brief Double the number of RIB hash buckets
+ *
+ * Keeps the current table if memory runs out; chains just get longer.
+ */
+static void rib_grow_hash(void) {
+    uint32_t new_size = g_routing_table.hash_size * 2;
+    rib_entry_t **table;
+    rib_entry_t *entry, *next;
+    uint32_t hash_index;
+    uint32_t i;
+
+    table = (rib_entry_t **)mem_calloc(MEM_TAG_FIB, new_size, sizeof(rib_entry_t *));
+    if (!table) {
+        LOG_WARNING(LOG_CATEGORY_L3, "No memory to grow the routing hash table to %u buckets", new_size);
+        return;
+    }
+
+    for (i = 0; i < g_routing_table.hash_size; i++) {
+        for (entry = g_routing_table.hash_table[i]; entry; entry = next) {
+            next = entry->next;
+            hash_index = route_hash(entry->vrf_id, &entry->info.prefix, entry->info.prefix_len,
+                                    entry->info.addr_type) & (new_size - 1);
+            entry->next = table[hash_index];
+            table[hash_index] = entry;
+        }
+    }
+
+    mem_free(MEM_TAG_FIB, g_routing_table.hash_table);
+    g_routing_table.hash_table = table;
+    g_routing_table.hash_size = new_size;
+}
+
+/**
+ * @brief Account for a candidate route entering or leaving the RIB
+ *
+ * @param entry Candidate
+ * @param added True if it was added, false if removed
+ */
+static void rib_count_route(const rib_entry_t *entry, bool added) {
+    int32_t delta = added ? 1 : -1;
+
+    g_routing_table.route_count += delta;
+    g_routing_table.vrfs[entry->vrf_id]->route_count += delta;
+    if (entry->stale) {
+        g_routing_table.stale_count += delta;
+    }
+    if (entry->info.addr_type == IP_TYPE_V4) {
+        g_routing_table.ipv4_count += delta;
+    } else {
+        g_routing_table.ipv6_count += delta;
+    }
+
+    g_routing_summary.route_count = g_routing_table.route_count;
+    g_routing_summary.changed = true;
+
+#if CONFIG_ENABLE_TRACING
+    if (trace_enabled(added ? TRACE_ROUTE_ADD : TRACE_ROUTE_REMOVE)) {
+        bool v6 = entry->info.addr_type == IP_TYPE_V6;
+        uint64_t prefix[2] = { 0, 0 };
+
+        if (v6) {
+            memcpy(prefix, &entry->info.prefix.addr.v6, sizeof(ipv6_addr_t));
+        } else {
+            memcpy(prefix, &entry->info.prefix.addr.v4, sizeof(ipv4_addr_t));
+        }
+        trace_record(added ? TRACE_ROUTE_ADD : TRACE_ROUTE_REMOVE,
+                     (uint32_t)entry->vrf_id << 16 | (v6 ? 6u : 4u) << 8 | entry->info.prefix_len,
+                     prefix[0], prefix[1]);
+    }
+#endif
+}
+
+/**
+ * @brief Append a candidate to the batch dirty list
+ *
+ * @param entry Candidate
+ * @return True if listed, false if the list could not grow
+ */
+static bool rib_batch_push(rib_entry_t *entry) {
+    rib_entry_t **dirty;
+    uint32_t capacity;
+
+    if (g_routing_table.batch_dirty_count == g_routing_table.batch_dirty_capacity) {
+        capacity = g_routing_table.batch_dirty_capacity ?
+                   g_routing_table.batch_dirty_capacity * 2 : ROUTE_BATCH_DIRTY_INITIAL;
+        /* The second half is scratch space for ordering the list on commit */
+        dirty = (rib_entry_t **)mem_realloc(MEM_TAG_FIB, g_routing_table.batch_dirty, 2 * capacity * sizeof(rib_entry_t *));
+        if (!dirty) {
+            return false;
+        }
+
+        g_routing_table.batch_dirty = dirty;
+        g_routing_table.batch_dirty_capacity = capacity;
+    }
+
+    g_routing_table.batch_dirty[g_routing_table.batch_dirty_count++] = entry;
+    entry->batch_slot = g_routing_table.batch_dirty_count;
+
+    return true;
+}
+
+/**
+ * @brief Record that a candidate's prefix must be reinstalled on commit
+ *
+ * If the record cannot be kept, the prefix is reinstalled right away.
+ *
+ * @param entry Candidate in the RIB
+ */
+static void rib_batch_mark(rib_entry_t *entry) {
+    rib_entry_t *head;
+
+    if (entry->batch_slot != 0 || rib_batch_push(entry)) {
+        return;
+    }
+
+    head = find_route_exact(entry->vrf_id, &entry->info.prefix, entry->info.prefix_len, entry->info.addr_type);
+    if (rib_commit_prefix(head, NULL) != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to install route outside of batch");
+    }
+}
+
+/**
+ * @brief Drop a candidate from the batch dirty list
+ *
+ * @param entry Candidate
+ */
+static void rib_batch_unmark(rib_entry_t *entry) {
+    if (entry->batch_slot != 0) {
+        g_routing_table.batch_dirty[entry->batch_slot - 1] = NULL;
+        entry->batch_slot = 0;
+    }
+}
+
+/**
+ * @brief Keep a removed candidate that is still installed until commit
+ *
+ * If it cannot be kept, its prefix is reinstalled right away.
+ *
+ * @param entry Removed candidate, already out of the RIB
+ * @param head Best remaining candidate of the prefix, NULL if none
+ */
+static void rib_batch_retire(rib_entry_t *entry, rib_entry_t *head) {
+    entry->alt = NULL;
+    if (rib_batch_push(entry)) {
+        entry->batch_slot = ROUTE_BATCH_RETIRED;
+        return;
+    }
+
+    if (!head) {
+        fib_withdraw(entry);
+    } else if (rib_commit_prefix(head, entry) != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to install next best route outside of batch");
+    }
+    free_route_entry(entry);
+}
+
+/**
+ * @brief Bring the FIB entry of a prefix in line with its candidates
+ *
+ * @param head Best candidate of the prefix
+ * @param installed Removed candidate still installed, NULL to look for
+ *                  the installed one among the prefix's candidates
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+static status_t rib_commit_prefix(rib_entry_t *head, rib_entry_t *installed) {
+    rib_entry_t *candidate;
+    status_t status;
+
+    for (candidate = head; candidate; candidate = candidate->alt) {
+        rib_batch_unmark(candidate);
+        if (candidate->group_index != 0) {
+            installed = candidate;
+        }
+    }
+
+    if (!installed) {
+        return fib_install(head);
+    }
+
+    status = fib_refresh(installed, head);
+    if (status != STATUS_SUCCESS) {
+        fib_withdraw(installed);
+    }
+
+    return status;
+}
+
+/**
+ * @brief Get the commit order key of a listed candidate
+ *
+ * @param entry Candidate in the batch dirty list
+ * @return Key, lower keys are committed first
+ */
+static inline uint32_t rib_batch_key(const rib_entry_t *entry) {
+    return 2U * entry->info.prefix_len + (entry->batch_slot == ROUTE_BATCH_RETIRED ? 0 : 1);
+}
+
+/**
+ * @brief Order the batch dirty list for commit
+ *
+ * Shorter prefixes go first, so a withdrawn prefix falls back to a
+ * covering prefix that is already reinstalled. Removed candidates go
+ * ahead of the remaining candidates of the same prefix. The sort is
+ * stable, keeping candidates in roughly arena order.
+ *
+ * @return Number of candidates left in the list
+ */
+static uint32_t rib_batch_sort(void) {
+    uint32_t offset[2 * ROUTE_MAX_PREFIX_LEN + 3];
+    rib_entry_t **dirty = g_routing_table.batch_dirty;
+    rib_entry_t **sorted = dirty + g_routing_table.batch_dirty_capacity;
+    uint32_t count = 0;
+    uint32_t key;
+    uint32_t i;
+
+    memset(offset, 0, sizeof(offset));
+    for (i = 0; i < g_routing_table.batch_dirty_count; i++) {
+        if (dirty[i]) {
+            offset[rib_batch_key(dirty[i]) + 1]++;
+            count++;
+        }
+    }
+    for (key = 1; key < 2 * ROUTE_MAX_PREFIX_LEN + 3; key++) {
+        offset[key] += offset[key - 1];
+    }
+
+    for (i = 0; i < g_routing_table.batch_dirty_count; i++) {
+        if (dirty[i]) {
+            sorted[offset[rib_batch_key(dirty[i])]++] = dirty[i];
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        dirty[i] = sorted[i];
+        if (dirty[i]->batch_slot != ROUTE_BATCH_RETIRED) {
+            dirty[i]->batch_slot = i + 1;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @brief Apply the FIB and hardware updates deferred by a batch
+ *
+ * Every changed prefix is reinstalled once, however often it changed
+ * during the batch, and the resulting hardware updates go out together.
+ *
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+static status_t rib_commit_batch(void) {
+    rib_entry_t **dirty = g_routing_table.batch_dirty;
+    rib_entry_t *entry;
+    rib_entry_t *head;
+    uint32_t count;
+    uint32_t failed = 0;
+    uint32_t i;
+
+    count = rib_batch_sort();
+
+    for (i = 0; i < count; i++) {
+        entry = dirty[i];
+        if (!entry) {
+            /* Reinstalled along with an earlier candidate of its prefix */
+            continue;
+        }
+
+        head = find_route_exact(entry->vrf_id, &entry->info.prefix, entry->info.prefix_len,
+                                entry->info.addr_type);
+        if (entry->batch_slot == ROUTE_BATCH_RETIRED) {
+            if (!head) {
+                fib_withdraw(entry);
+            } else if (rib_commit_prefix(head, entry) != STATUS_SUCCESS) {
+                failed++;
+            }
+            free_route_entry(entry);
+        } else if (rib_commit_prefix(head, NULL) != STATUS_SUCCESS) {
+            failed++;
+        }
+    }
+
+    g_routing_table.batch_dirty_count = 0;
+    g_routing_table.batch_active = false;
+
+    if (failed > 0) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing batch commit left %u prefixes out of the FIB", failed);
+        return STATUS_NO_MEMORY;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Check whether two candidates describe the same path
+ *
+ * @param a Route information
+ * @param b Route information
+ * @return True if both come from the same source and use the same next hop
+ */
+static bool route_same_path(const rib_route_t *a, const rib_route_t *b) {
+    return a->source == b->source &&
+           a->interface_index == b->interface_index &&
+           memcmp(route_addr_bytes(&a->next_hop, a->addr_type), route_addr_bytes(&b->next_hop, b->addr_type),
+                  (a->addr_type == IP_TYPE_V4 ? IPV4_ADDR_LEN : IPV6_ADDR_LEN)) == 0;
+}
+
+/**
+ * @brief List a leaked candidate so its source VRF's changes reach it
+ *
+ * @param entry Candidate just added to the RIB
+ */
+static inline void rib_link_leak(rib_entry_t *entry) {
+    if (entry->leak_vrf != ROUTE_VRF_NONE) {
+        entry->leak_next = g_routing_table.leaks;
+        g_routing_table.leaks = entry;
+    }
+}
+
+/**
+ * @brief Add a candidate route to the RIB
+ *
+ * A source may offer several paths for a prefix. The most preferred
+ * candidate of each prefix and its equal-cost peers are installed in the
+ * FIB as one next-hop group.
+ *
+ * A leaked candidate forwards along whatever route its source VRF has
+ * installed for the prefix. It is the least preferred candidate, so a
+ * route of the VRF's own overrides it.
+ *
+ * @param vrf_id VRF the route belongs to
+ * @param route Route information
+ * @param leak_vrf VRF the prefix is leaked from, ROUTE_VRF_NONE if not leaked
+ * @return STATUS_SUCCESS if successful, STATUS_ALREADY_EXISTS if the source
+ *         already has this path for the prefix, error code otherwise
+ */
+static status_t rib_add_route(uint16_t vrf_id, const rib_route_t *route, uint16_t leak_vrf) {
+    rib_entry_t **link;
+    rib_entry_t **pos;
+    rib_entry_t *head;
+    rib_entry_t *entry;
+    uint8_t max_len = (route->addr_type == IP_TYPE_V4) ? 32 : 128;
+    status_t status;
+
+    if ((route->addr_type != IP_TYPE_V4 && route->addr_type != IP_TYPE_V6) ||
+        route->prefix_len > max_len) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    entry = allocate_route_entry();
+    if (!entry) {
+        return STATUS_NO_MEMORY;
+    }
+
+    memcpy(&entry->info, route, sizeof(rib_route_t));
+    mask_prefix(&entry->info.prefix, route->prefix_len, route->addr_type);
+    entry->stale = g_routing_table.restoring && leak_vrf == ROUTE_VRF_NONE;
+    entry->vrf_id = vrf_id;
+    entry->leak_vrf = leak_vrf;
+    if (leak_vrf == ROUTE_VRF_NONE) {
+        entry->admin_distance = route_admin_distance(route->source);
+    } else {
+        entry->admin_distance = ROUTE_ADMIN_DISTANCE_UNKNOWN;
+        entry->info.metric = UINT16_MAX;
+    }
+
+    link = find_route_link(vrf_id, &entry->info.prefix, route->prefix_len, route->addr_type);
+    head = *link;
+
+    if (!head) {
+        /* First candidate for the prefix */
+        if (!g_routing_table.batch_active) {
+            status = fib_install(entry);
+            if (status != STATUS_SUCCESS) {
+                free_route_entry(entry);
+                return status;
+            }
+        }
+
+        *link = entry;
+        g_routing_table.prefix_count++;
+        if (g_routing_table.prefix_count > g_routing_table.hash_size) {
+            rib_grow_hash();
+        }
+
+        if (g_routing_table.batch_active) {
+            rib_batch_mark(entry);
+        }
+
+        rib_count_route(entry, true);
+        rib_link_leak(entry);
+        return STATUS_SUCCESS;
+    }
+
+    for (pos = link; *pos; pos = &(*pos)->alt) {
+        if ((*pos)->leak_vrf == leak_vrf &&
+            (leak_vrf != ROUTE_VRF_NONE || route_same_path(&(*pos)->info, route))) {
+            if ((*pos)->stale && !g_routing_table.restoring) {
+                /* Its source still has the path: the restored copy is current again */
+                (*pos)->stale = false;
+                g_routing_table.stale_count--;
+            }
+            free_route_entry(entry);
+            return STATUS_ALREADY_EXISTS;
+        }
+    }
+
+    if (route_preferred(entry, head)) {
+        /* New best candidate takes over the hash chain slot */
+        entry->next = head->next;
+        entry->alt = head;
+        head->next = NULL;
+        *link = entry;
+    } else {
+        for (pos = &head->alt; *pos && !route_preferred(entry, *pos); pos = &(*pos)->alt) {
+        }
+        entry->alt = *pos;
+        *pos = entry;
+    }
+
+    if (g_routing_table.batch_active) {
+        rib_batch_mark(entry);
+    } else if (*link == entry || !route_preferred(head, entry)) {
+        /* A new best or equal-cost path changes what the FIB forwards along */
+        status = fib_refresh(head, *link);
+        if (status != STATUS_SUCCESS) {
+            if (*link == entry) {
+                head->next = entry->next;
+                *link = head;
+            } else {
+                for (pos = &head->alt; *pos != entry; pos = &(*pos)->alt) {
+                }
+                *pos = entry->alt;
+            }
+            free_route_entry(entry);
+            return status;
+        }
+    }
+
+    rib_count_route(entry, true);
+    rib_link_leak(entry);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Remove candidate routes from the RIB
+ *
+ * When the best candidates go, the next ones are installed in the FIB; when
+ * the last one goes, the prefix is withdrawn.
+ *
+ * @param vrf_id VRF the routes belong to
+ * @param prefix IP address prefix
+ * @param prefix_len Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ * @param source Source whose paths are removed, NULL to remove all;
+ *               ignored for a leak
+ * @param leak_vrf VRF whose leak of the prefix is removed, ROUTE_VRF_NONE
+ *                 to remove the VRF's own paths
+ * @param stale_only Remove only candidates still stale after a warm restart
+ * @return STATUS_SUCCESS if successful, STATUS_NOT_FOUND otherwise
+ */
+static status_t rib_remove_route(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t prefix_len,
+                                 ip_addr_type_t type, const route_source_t *source, uint16_t leak_vrf,
+                                 bool stale_only) {
+    rib_entry_t **link;
+    rib_entry_t **pos;
+    rib_entry_t *head, *new_head;
+    rib_entry_t *removed = NULL;
+    rib_entry_t *entry, *next;
+    ip_addr_t key = *prefix;
+
+    mask_prefix(&key, prefix_len, type);
+    link = find_route_link(vrf_id, &key, prefix_len, type);
+    head = *link;
+    if (!head) {
+        return STATUS_NOT_FOUND;
+    }
+
+    /* Detach the candidates being removed */
+    new_head = head;
+    for (pos = &new_head; *pos; ) {
+        if ((*pos)->leak_vrf == leak_vrf && (!stale_only || (*pos)->stale) &&
+            (leak_vrf != ROUTE_VRF_NONE || source == NULL || (*pos)->info.source == *source)) {
+            entry = *pos;
+            *pos = entry->alt;
+            entry->alt = removed;
+            removed = entry;
+        } else {
+            pos = &(*pos)->alt;
+        }
+    }
+
+    if (!removed) {
+        return STATUS_NOT_FOUND;
+    }
+
+    if (!new_head) {
+        if (!g_routing_table.batch_active) {
+            fib_withdraw(head);
+        }
+        *link = head->next;
+        g_routing_table.prefix_count--;
+    } else {
+        if (new_head != head) {
+            new_head->next = head->next;
+            head->next = NULL;
+            *link = new_head;
+        }
+        if (!g_routing_table.batch_active && fib_refresh(head, new_head) != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_L3, "Failed to install next best route, withdrawing prefix from FIB");
+            fib_withdraw(head);
+        }
+    }
+
+    for (entry = removed; entry; entry = next) {
+        next = entry->alt;
+        rib_count_route(entry, false);
+        rib_batch_unmark(entry);
+
+        /* Only set while a batch defers the withdrawal */
+        if (entry->group_index != 0) {
+            rib_batch_retire(entry, new_head);
+        } else {
+            free_route_entry(entry);
+        }
+    }
+
+    if (g_routing_table.batch_active && new_head) {
+        rib_batch_mark(new_head);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Add routes given in the exported form
+ *
+ * Joins the batch in progress or commits one of its own. Routes already
+ * present or invalid are skipped. Called with the routing lock held.
+ *
+ * @param routes Routes to add
+ * @param count Number of routes
+ * @param[out] added Number of routes added, may be NULL
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+static status_t rib_add_route_list(const routing_route_t *routes, uint32_t count, uint32_t *added) {
+    rib_route_t route;
+    bool own_batch;
+    uint32_t done = 0;
+    uint32_t i;
+    status_t status = STATUS_SUCCESS;
+
+    memset(&route, 0, sizeof(route));
+    own_batch = !g_routing_table.batch_active;
+    g_routing_table.batch_active = true;
+
+    for (i = 0; i < count; i++) {
+        route.prefix = routes[i].prefix;
+        route.next_hop = routes[i].next_hop;
+        route.prefix_len = routes[i].prefix_len;
+        route.interface_index = routes[i].interface_index;
+        route.metric = routes[i].metric;
+        route.addr_type = routes[i].type;
+        route.source = routes[i].source;
+
+        status = rib_add_route(ROUTING_VRF_DEFAULT, &route, ROUTE_VRF_NONE);
+        if (status == STATUS_SUCCESS) {
+            done++;
+        } else if (status == STATUS_ALREADY_EXISTS || status == STATUS_INVALID_PARAMETER) {
+            status = STATUS_SUCCESS;
+        } else {
+            LOG_ERROR(LOG_CATEGORY_L3, "Bulk route add stopped after %u of %u routes", done, count);
+            break;
+        }
+    }
+
+    if (own_batch) {
+        status_t commit_status = rib_commit_batch();
+        if (status == STATUS_SUCCESS) {
+            status = commit_status;
+        }
+    }
+
+    if (added) {
+        *added = done;
+    }
+
+    return status;
+}
+
+/**
+ * @brief Remove every route from the RIB and the FIB
+ */
+static void rib_flush(void) {
+    rib_entry_t *head, *entry;
+    uint32_t i;
+
+    /* Withdraw installed routes from hardware, including ones a batch left behind */
+    if (g_routing_table.hw_sync_enabled) {
+        for (i = 0; i < g_routing_table.batch_dirty_count; i++) {
+            entry = g_routing_table.batch_dirty[i];
+            if (entry && entry->batch_slot == ROUTE_BATCH_RETIRED) {
+                sync_route_to_hw(entry, HW_OPERATION_DELETE);
+            }
+        }
+        for (i = 0; i < g_routing_table.hash_size; i++) {
+            for (head = g_routing_table.hash_table[i]; head; head = head->next) {
+                for (entry = head; entry; entry = entry->alt) {
+                    if (entry->group_index != 0) {
+                        sync_route_to_hw(entry, HW_OPERATION_DELETE);
+                    }
+                }
+            }
+        }
+    }
+
+    /* Readers are gone from the FIB before the entries it named are freed */
+    memset(g_routing_table.hash_table, 0, g_routing_table.hash_size * sizeof(rib_entry_t *));
+    g_routing_table.leaks = NULL;
+    fib_flush();
+    rib_free_arena();
+
+    g_routing_summary.route_count = 0;
+    g_routing_summary.changed = true;
+}
+
+
+
+
+/* --- HARDWARE SYNCHRONIZATION --------------------------------------------- */
+static void sync_route_to_hw(const rib_entry_t *entry, hw_operation_t operation);
+
+/**
+ * @brief Queue a route operation for the hardware
+ *
+ * Called with the routing lock held. Operations for a prefix still waiting
+ * in the queue fold into one: the prefix is written once with its latest
+ * route, and not at all if it ends up as it started. Writers wait only
+ * when the queue is full of distinct prefixes.
+ *
+ * @param entry Route entry to synchronize
+ * @param operation Hardware operation (add or delete)
+ */
+static void sync_route_to_hw(const rib_entry_t *entry, hw_operation_t operation) {
+    const uint32_t mask = HW_SYNC_HASH_SLOTS - 1;
+    hw_sync_op_t *op;
+    uint32_t hash, slot, buffer;
+    uint64_t tag;
+
+    /* Hardware routes carry no VRF; only the default VRF's own routes go there */
+    if (entry->vrf_id != ROUTING_VRF_DEFAULT || entry->leak_vrf != ROUTE_VRF_NONE) {
+        return;
+    }
+    if (operation != HW_OPERATION_ADD && operation != HW_OPERATION_DELETE) {
+        return;
+    }
+
+    hash = (entry->info.addr_type == IP_TYPE_V4) ?
+               hash_ipv4_prefix(&entry->info.prefix.addr.v4, entry->info.prefix_len) :
+               hash_ipv6_prefix(&entry->info.prefix.addr.v6, entry->info.prefix_len);
+
+    pthread_mutex_lock(&g_hw_sync.lock);
+    g_hw_sync.queued++;
+
+    for (;;) {
+        buffer = g_hw_sync.filling;
+
+        /* A prefix already queued takes the new operation in place */
+        for (slot = hash & mask; ; slot = (slot + 1) & mask) {
+            tag = g_hw_sync.slots[slot];
+            if ((uint32_t)(tag >> 32) != g_hw_sync.generation) {
+                break;
+            }
+            op = &g_hw_sync.ops[buffer][(uint32_t)tag - 1];
+            if (op->hash == hash &&
+                op->route.addr_type == entry->info.addr_type &&
+                op->route.prefix_len == entry->info.prefix_len &&
+                memcmp(&op->route.prefix, &entry->info.prefix, sizeof(op->route.prefix)) == 0) {
+                memcpy(&op->route, &entry->info, sizeof(rib_route_t));
+                op->present_after = (operation == HW_OPERATION_ADD);
+                g_hw_sync.merged++;
+                pthread_mutex_unlock(&g_hw_sync.lock);
+                return;
+            }
+        }
+
+        if (g_hw_sync.count[buffer] < CONFIG_ROUTE_HW_QUEUE_SIZE) {
+            break;
+        }
+
+        /* Full: wait for the thread to take the buffer, then look again */
+        g_hw_sync.stalls++;
+        pthread_cond_signal(&g_hw_sync.wake);
+        while (g_hw_sync.filling == buffer) {
+            pthread_cond_wait(&g_hw_sync.done, &g_hw_sync.lock);
+        }
+    }
+
+    op = &g_hw_sync.ops[buffer][g_hw_sync.count[buffer]];
+    memcpy(&op->route, &entry->info, sizeof(rib_route_t));
+    op->hash = hash;
+    op->present_before = (operation == HW_OPERATION_DELETE);
+    op->present_after = (operation == HW_OPERATION_ADD);
+    g_hw_sync.slots[slot] = ((uint64_t)g_hw_sync.generation << 32) | (g_hw_sync.count[buffer] + 1);
+    g_hw_sync.count[buffer]++;
+
+    if (g_hw_sync.count[buffer] == CONFIG_ROUTE_HW_BATCH) {
+        pthread_cond_signal(&g_hw_sync.wake);
+    }
+    pthread_mutex_unlock(&g_hw_sync.lock);
+}
+
+/**
+ * @brief Allocate the hardware programming queue and start its thread
+ *
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+static status_t hw_sync_init(void) {
+    memset(&g_hw_sync, 0, sizeof(g_hw_sync));
+
+    g_hw_sync.ops[0] = mem_calloc(MEM_TAG_FIB, CONFIG_ROUTE_HW_QUEUE_SIZE, sizeof(hw_sync_op_t));
+    g_hw_sync.ops[1] = mem_calloc(MEM_TAG_FIB, CONFIG_ROUTE_HW_QUEUE_SIZE, sizeof(hw_sync_op_t));
+    g_hw_sync.slots = mem_calloc(MEM_TAG_FIB, HW_SYNC_HASH_SLOTS, sizeof(uint64_t));
+    if (!g_hw_sync.ops[0] || !g_hw_sync.ops[1] || !g_hw_sync.slots) {
+        mem_free(MEM_TAG_FIB, g_hw_sync.ops[0]);
+        mem_free(MEM_TAG_FIB, g_hw_sync.ops[1]);
+        mem_free(MEM_TAG_FIB, g_hw_sync.slots);
+        return STATUS_NO_MEMORY;
+    }
+    g_hw_sync.generation = 1;
+
+    pthread_mutex_init(&g_hw_sync.lock, NULL);
+    pthread_cond_init(&g_hw_sync.wake, NULL);
+    pthread_cond_init(&g_hw_sync.done, NULL);
+
+    g_hw_sync.running = true;
+    if (pthread_create(&g_hw_sync.thread, NULL, hw_sync_thread, NULL) != 0) {
+        pthread_cond_destroy(&g_hw_sync.done);
+        pthread_cond_destroy(&g_hw_sync.wake);
+        pthread_mutex_destroy(&g_hw_sync.lock);
+        mem_free(MEM_TAG_FIB, g_hw_sync.ops[0]);
+        mem_free(MEM_TAG_FIB, g_hw_sync.ops[1]);
+        mem_free(MEM_TAG_FIB, g_hw_sync.slots);
+        return STATUS_FAILURE;
+    }
+    pthread_setname_np(g_hw_sync.thread, "route-hw");
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Program what is still queued, stop the thread and free the queue
+ */
+static void hw_sync_deinit(void) {
+    pthread_mutex_lock(&g_hw_sync.lock);
+    g_hw_sync.running = false;
+    pthread_cond_signal(&g_hw_sync.wake);
+    pthread_mutex_unlock(&g_hw_sync.lock);
+    pthread_join(g_hw_sync.thread, NULL);
+
+    pthread_cond_destroy(&g_hw_sync.done);
+    pthread_cond_destroy(&g_hw_sync.wake);
+    pthread_mutex_destroy(&g_hw_sync.lock);
+    mem_free(MEM_TAG_FIB, g_hw_sync.ops[0]);
+    mem_free(MEM_TAG_FIB, g_hw_sync.ops[1]);
+    mem_free(MEM_TAG_FIB, g_hw_sync.slots);
+    g_hw_sync.ops[0] = g_hw_sync.ops[1] = NULL;
+    g_hw_sync.slots = NULL;
+
+    if (g_hw_sync.missing) {
+        for (uint32_t i = 0; i < HW_SYNC_MISSING_BUCKETS; i++) {
+            hw_sync_missing_t *missing = g_hw_sync.missing[i];
+            while (missing) {
+                hw_sync_missing_t *next = missing->next;
+                mem_free(MEM_TAG_FIB, missing);
+                missing = next;
+            }
+        }
+        mem_free(MEM_TAG_FIB, g_hw_sync.missing);
+        g_hw_sync.missing = NULL;
+        g_hw_sync.missing_count = 0;
+    }
+}
+
+/**
+ * @brief Current monotonic time in nanoseconds
+ */
+static uint64_t hw_sync_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * HW_SYNC_NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Hardware programming thread
+ *
+ * Takes the filling buffer once it holds a batch, or after
+ * CONFIG_ROUTE_HW_INTERVAL_MS otherwise, and programs it batch by batch
+ * outside the queue lock while writers fill the other buffer.
+ */
+static void *hw_sync_thread(void *arg) {
+    hw_sync_op_t *ops;
+    struct timespec deadline;
+    uint64_t start, elapsed;
+    uint32_t buffer, count, i, end, written, cancelled, failed;
+
+    (void)arg;
+
+    pthread_mutex_lock(&g_hw_sync.lock);
+    for (;;) {
+        buffer = g_hw_sync.filling;
+        if (g_hw_sync.count[buffer] == 0) {
+            if (!g_hw_sync.running) {
+                break;
+            }
+            pthread_cond_wait(&g_hw_sync.wake, &g_hw_sync.lock);
+            continue;
+        }
+
+        /* Give a partial batch a moment to fill and fold */
+        if (g_hw_sync.running && g_hw_sync.flush_waiters == 0 &&
+            g_hw_sync.count[buffer] < CONFIG_ROUTE_HW_BATCH) {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += (long)(CONFIG_ROUTE_HW_INTERVAL_MS * HW_SYNC_NS_PER_MS);
+            deadline.tv_sec += deadline.tv_nsec / (long)HW_SYNC_NS_PER_SEC;
+            deadline.tv_nsec %= (long)HW_SYNC_NS_PER_SEC;
+            while (g_hw_sync.running && g_hw_sync.flush_waiters == 0 &&
+                   g_hw_sync.count[buffer] < CONFIG_ROUTE_HW_BATCH) {
+                if (pthread_cond_timedwait(&g_hw_sync.wake, &g_hw_sync.lock, &deadline) != 0) {
+                    break;
+                }
+            }
+        }
+
+        /* Take the buffer; the prefix hash belongs to the other one from now on */
+        ops = g_hw_sync.ops[buffer];
+        count = g_hw_sync.count[buffer];
+        g_hw_sync.filling = buffer ^ 1;
+        if (++g_hw_sync.generation == 0) {
+            memset(g_hw_sync.slots, 0, HW_SYNC_HASH_SLOTS * sizeof(uint64_t));
+            g_hw_sync.generation = 1;
+        }
+        g_hw_sync.busy = true;
+        pthread_cond_broadcast(&g_hw_sync.done);
+        pthread_mutex_unlock(&g_hw_sync.lock);
+
+        for (i = 0; i < count; i = end) {
+            end = (count - i > CONFIG_ROUTE_HW_BATCH) ? i + CONFIG_ROUTE_HW_BATCH : count;
+
+            start = hw_sync_now_ns();
+            hw_sync_program(&ops[i], end - i, &written, &cancelled, &failed);
+            elapsed = hw_sync_now_ns() - start;
+
+            pthread_mutex_lock(&g_hw_sync.lock);
+            g_hw_sync.cancelled += cancelled;
+            g_hw_sync.programmed += written;
+            g_hw_sync.failed += failed;
+            g_hw_sync.batches++;
+            g_hw_sync.batch_last_ns = elapsed;
+            g_hw_sync.batch_total_ns += elapsed;
+            if (elapsed > g_hw_sync.batch_max_ns) {
+                g_hw_sync.batch_max_ns = elapsed;
+            }
+            pthread_mutex_unlock(&g_hw_sync.lock);
+
+            if (failed > 0) {
+                LOG_WARNING(LOG_CATEGORY_L3, "Hardware route table full, %u routes not programmed",
+                            failed);
+            }
+            LOG_DEBUG(LOG_CATEGORY_L3, "Programmed %u route operations to hardware in %llu ns",
+                      written, (unsigned long long)elapsed);
+        }
+
+        pthread_mutex_lock(&g_hw_sync.lock);
+        g_hw_sync.count[buffer] = 0;
+        g_hw_sync.busy = false;
+        pthread_cond_broadcast(&g_hw_sync.done);
+    }
+    pthread_mutex_unlock(&g_hw_sync.lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Find a prefix among the ones the hardware refused and forget it
+ *
+ * @param op Queued prefix
+ * @return true if the prefix was refused, false otherwise
+ */
+static bool hw_sync_missing_take(const hw_sync_op_t *op) {
+    hw_sync_missing_t **link, *missing;
+
+    if (g_hw_sync.missing_count == 0) {
+        return false;
+    }
+
+    for (link = &g_hw_sync.missing[op->hash & (HW_SYNC_MISSING_BUCKETS - 1)]; *link;
+         link = &(*link)->next) {
+        missing = *link;
+        if (missing->hash == op->hash &&
+            missing->route.addr_type == op->route.addr_type &&
+            missing->route.prefix_len == op->route.prefix_len &&
+            memcmp(&missing->route.prefix, &op->route.prefix, sizeof(missing->route.prefix)) == 0) {
+            *link = missing->next;
+            mem_free(MEM_TAG_FIB, missing);
+            g_hw_sync.missing_count--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Remember a prefix the hardware refused
+ *
+ * Its delete, when it comes, then releases nothing, and a later replace
+ * tries to reserve its entry again.
+ *
+ * @param op Queued prefix
+ */
+static void hw_sync_missing_put(const hw_sync_op_t *op) {
+    hw_sync_missing_t *missing;
+    uint32_t bucket = op->hash & (HW_SYNC_MISSING_BUCKETS - 1);
+
+    if (!g_hw_sync.missing) {
+        g_hw_sync.missing = mem_calloc(MEM_TAG_FIB, HW_SYNC_MISSING_BUCKETS, sizeof(hw_sync_missing_t *));
+        if (!g_hw_sync.missing) {
+            LOG_ERROR(LOG_CATEGORY_L3, "Failed to allocate the refused hardware route set");
+            return;
+        }
+    }
+
+    missing = mem_malloc(MEM_TAG_FIB, sizeof(hw_sync_missing_t));
+    if (!missing) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to remember a refused hardware route");
+        return;
+    }
+    memcpy(&missing->route, &op->route, sizeof(rib_route_t));
+    missing->hash = op->hash;
+    missing->next = g_hw_sync.missing[bucket];
+    g_hw_sync.missing[bucket] = missing;
+    g_hw_sync.missing_count++;
+}
+
+/**
+ * @brief Write the final state of a batch of queued prefixes to the hardware
+ *
+ * Every route the hardware holds owns one HW_RESOURCE_ROUTE_TABLE entry.
+ * Deletes release theirs first, so that the adds of the same batch can
+ * reuse them, and the adds then reserve theirs with a single call. When
+ * that fails the adds reserve one at a time until the table is full; the
+ * rest are left out of the hardware and counted as failed. A prefix
+ * present both before and after its operations is replaced in place.
+ *
+ * @param ops Queued prefixes; the thread owns them while it programs them
+ * @param count Number of prefixes
+ * @param[out] written Hardware writes made
+ * @param[out] cancelled Prefixes whose operations cancelled out
+ * @param[out] failed Routes the hardware had no room for
+ */
+static void hw_sync_program(hw_sync_op_t *ops, uint32_t count, uint32_t *written,
+                            uint32_t *cancelled, uint32_t *failed) {
+    uint32_t adds = 0, deletes = 0, i;
+    bool reserved, full = false;
+    status_t status;
+
+    *written = 0;
+    *cancelled = 0;
+    *failed = 0;
+
+    for (i = 0; i < count; i++) {
+        /* A refused prefix was never in the hardware, whatever the RIB says */
+        if (ops[i].present_before && hw_sync_missing_take(&ops[i])) {
+            ops[i].present_before = false;
+        }
+        if (ops[i].present_before && !ops[i].present_after) {
+            deletes++;
+        } else if (!ops[i].present_before && ops[i].present_after) {
+            adds++;
+        }
+    }
+
+    if (deletes > 0) {
+        status = hw_resources_release(HW_RESOURCE_ROUTE_TABLE, deletes);
+        if (status != STATUS_SUCCESS) {
+            LOG_WARNING(LOG_CATEGORY_L3, "Failed to release %u hardware route entries: %d", deletes, status);
+        }
+    }
+    reserved = (adds > 0 && hw_resources_reserve(HW_RESOURCE_ROUTE_TABLE, adds) == STATUS_SUCCESS);
+
+    for (i = 0; i < count; i++) {
+        hw_sync_op_t *op = &ops[i];
+        const rib_route_t *route = &op->route;
+
+        if (!op->present_before && !op->present_after) {
+            (*cancelled)++;
+            continue;
+        }
+
+        if (!op->present_before && !reserved) {
+            if (full || hw_resources_reserve(HW_RESOURCE_ROUTE_TABLE, 1) != STATUS_SUCCESS) {
+                full = true;
+                hw_sync_missing_put(op);
+                (*failed)++;
+                continue;
+            }
+        }
+
+        LOG_TRACE(LOG_CATEGORY_L3, "Hardware route %s: %s/%u via %s, interface %u",
+                  !op->present_after ? "delete" : op->present_before ? "replace" : "add",
+                  route_addr_str(&route->prefix, route->addr_type), route->prefix_len,
+                  route_addr_str(&route->next_hop, route->addr_type), route->interface_index);
+        *written += (op->present_before && op->present_after) ? 2 : 1;
+    }
+}
+
+/**
+ * @brief Fill in the hardware programming queue statistics
+ *
+ * @param stats Statistics to fill in
+ */
+static void hw_sync_get_stats(routing_table_stats_t *stats) {
+    pthread_mutex_lock(&g_hw_sync.lock);
+    stats->hw_queue_depth = g_hw_sync.count[0] + g_hw_sync.count[1];
+    stats->hw_ops_queued = g_hw_sync.queued;
+    stats->hw_ops_merged = g_hw_sync.merged;
+    stats->hw_ops_cancelled = g_hw_sync.cancelled;
+    stats->hw_ops_programmed = g_hw_sync.programmed;
+    stats->hw_ops_failed = g_hw_sync.failed;
+    stats->hw_queue_stalls = g_hw_sync.stalls;
+    stats->hw_batches = g_hw_sync.batches;
+    stats->hw_batch_last_ns = g_hw_sync.batch_last_ns;
+    stats->hw_batch_max_ns = g_hw_sync.batch_max_ns;
+    stats->hw_batch_total_ns = g_hw_sync.batch_total_ns;
+    pthread_mutex_unlock(&g_hw_sync.lock);
+}
+
+
+
+
+/**
+ * @brief Create a VRF with an empty routing table
+ *
+ * The VRF shares next hops and next-hop groups with every other VRF.
+ *
+ * @param vrf_id VRF identifier, below ROUTING_MAX_VRFS
+ * @return STATUS_SUCCESS if successful, STATUS_ALREADY_EXISTS if the VRF
+ *         exists, error code otherwise
+ */
+status_t routing_vrf_create(uint16_t vrf_id) {
+    status_t status;
+
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (vrf_id >= ROUTING_MAX_VRFS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid VRF %u", vrf_id);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    ROUTING_LOCK();
+    if (g_routing_table.vrfs[vrf_id]) {
+        ROUTING_UNLOCK();
+        LOG_WARNING(LOG_CATEGORY_L3, "VRF %u already exists", vrf_id);
+        return STATUS_ALREADY_EXISTS;
+    }
+    status = fib_vrf_create(vrf_id);
+    ROUTING_UNLOCK();
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "No memory for VRF %u", vrf_id);
+        return status;
+    }
+
+    LOG_INFO(LOG_CATEGORY_L3, "Created VRF %u", vrf_id);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Delete an empty VRF
+ *
+ * Its interfaces go back to the default VRF. A VRF that still has routes,
+ * or whose prefixes are leaked elsewhere, is kept.
+ *
+ * @param vrf_id VRF identifier, not ROUTING_VRF_DEFAULT
+ * @return STATUS_SUCCESS if successful, STATUS_RESOURCE_BUSY if the VRF is
+ *         in use, error code otherwise
+ */
+status_t routing_vrf_delete(uint16_t vrf_id) {
+    const rib_entry_t *leak;
+    uint32_t i;
+
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (vrf_id == ROUTING_VRF_DEFAULT || vrf_id >= ROUTING_MAX_VRFS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid VRF %u for deletion", vrf_id);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    ROUTING_LOCK();
+    if (!g_routing_table.vrfs[vrf_id]) {
+        ROUTING_UNLOCK();
+        LOG_WARNING(LOG_CATEGORY_L3, "VRF %u not found for deletion", vrf_id);
+        return STATUS_NOT_FOUND;
+    }
+
+    for (leak = g_routing_table.leaks; leak; leak = leak->leak_next) {
+        if (leak->leak_vrf == vrf_id) {
+            break;
+        }
+    }
+    if (g_routing_table.vrfs[vrf_id]->route_count > 0 || leak || g_routing_table.batch_active) {
+        ROUTING_UNLOCK();
+        LOG_WARNING(LOG_CATEGORY_L3, "VRF %u still has routes", vrf_id);
+        return STATUS_RESOURCE_BUSY;
+    }
+
+    for (i = 0; i < ROUTING_MAX_INTERFACES; i++) {
+        if (g_routing_table.interface_vrf[i] == vrf_id) {
+            __atomic_store_n(&g_routing_table.interface_vrf[i], ROUTING_VRF_DEFAULT, __ATOMIC_RELAXED);
+        }
+    }
+    fib_vrf_destroy(vrf_id);
+    ROUTING_UNLOCK();
+
+    LOG_INFO(LOG_CATEGORY_L3, "Deleted VRF %u", vrf_id);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Bind an interface to a VRF
+ *
+ * Packets received on the interface are routed in the VRF.
+ *
+ * @param interface_index Interface
+ * @param vrf_id Existing VRF
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+status_t routing_interface_set_vrf(uint16_t interface_index, uint16_t vrf_id) {
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (vrf_id >= ROUTING_MAX_VRFS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid VRF %u", vrf_id);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    ROUTING_LOCK();
+    if (!g_routing_table.vrfs[vrf_id]) {
+        ROUTING_UNLOCK();
+        LOG_ERROR(LOG_CATEGORY_L3, "VRF %u does not exist", vrf_id);
+        return STATUS_NOT_FOUND;
+    }
+    __atomic_store_n(&g_routing_table.interface_vrf[interface_index], vrf_id, __ATOMIC_RELAXED);
+    ROUTING_UNLOCK();
+
+    LOG_INFO(LOG_CATEGORY_L3, "Bound interface %u to VRF %u", interface_index, vrf_id);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Get the VRF an interface is bound to
+ *
+ * Lock-free, for the forwarding path.
+ *
+ * @param interface_index Interface
+ * @return VRF of the interface, ROUTING_VRF_DEFAULT unless bound to another
+ */
+uint16_t routing_interface_get_vrf(uint16_t interface_index) {
+    return __atomic_load_n(&g_routing_table.interface_vrf[interface_index], __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Insert a route into the routing table of a VRF
+ *
+ * Each source may offer several paths per prefix; the VRF forwards along
+ * the ones with the lowest administrative distance and metric. A route of
+ * the VRF's own overrides a prefix leaked into it.
+ *
+ * @param vrf_id VRF to add the route to
+ * @param prefix IP address prefix for the route
+ * @param prefix_len Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ * @param next_hop Next hop IP address
+ * @param interface_index Outgoing interface index
+ * @param metric Route metric
+ * @param route_source Source of the route
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+status_t routing_vrf_add_route(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t prefix_len,
+                               ip_addr_type_t type, const ip_addr_t *next_hop, uint16_t interface_index,
+                               uint16_t metric, route_source_t route_source) {
+    rib_route_t route;
+    status_t status;
+
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (!prefix || !next_hop || vrf_id >= ROUTING_MAX_VRFS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameters for routing_vrf_add_route");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Validate prefix length */
+    if ((type == IP_TYPE_V4 && prefix_len > 32) ||
+        (type == IP_TYPE_V6 && prefix_len > 128)) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid prefix length for route: %u", prefix_len);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Set route information */
+    memset(&route, 0, sizeof(route));
+    memcpy(&route.prefix, prefix, sizeof(ip_addr_t));
+    memcpy(&route.next_hop, next_hop, sizeof(ip_addr_t));
+    route.prefix_len = prefix_len;
+    route.interface_index = interface_index;
+    route.metric = metric;
+    route.addr_type = type;
+    route.source = route_source;
+
+    ROUTING_LOCK();
+    if (!g_routing_table.vrfs[vrf_id]) {
+        ROUTING_UNLOCK();
+        LOG_ERROR(LOG_CATEGORY_L3, "VRF %u does not exist", vrf_id);
+        return STATUS_NOT_FOUND;
+    }
+    status = rib_add_route(vrf_id, &route, ROUTE_VRF_NONE);
+    ROUTING_UNLOCK();
+    if (status == STATUS_ALREADY_EXISTS) {
+        LOG_WARNING(LOG_CATEGORY_L3, "Route already exists in VRF %u", vrf_id);
+        return status;
+    }
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to add route to VRF %u: %s/%u", vrf_id, route_addr_str(prefix, type), prefix_len);
+        return status;
+    }
+
+    LOG_INFO(LOG_CATEGORY_L3, "Added route to VRF %u: %s/%u via interface %u",
+             vrf_id, route_addr_str(prefix, type), prefix_len, interface_index);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Insert a route into the routing table
+ *
+ * Each source may offer several paths per prefix; the routing table forwards
+ * along the ones with the lowest administrative distance and metric.
+ *
+ * @param prefix IP address prefix for the route
+ * @param prefix_len Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ * @param next_hop Next hop IP address
+ * @param interface_index Outgoing interface index
+ * @param metric Route metric
+ * @param route_source Source of the route
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+status_t routing_add_route(const ip_addr_t *prefix, uint8_t prefix_len, ip_addr_type_t type,
+                         const ip_addr_t *next_hop, uint16_t interface_index,
+                         uint16_t metric, route_source_t route_source) {
+    return routing_vrf_add_route(ROUTING_VRF_DEFAULT, prefix, prefix_len, type, next_hop,
+                                 interface_index, metric, route_source);
+}
+
+/**
+ * @brief Remove routes from the routing table of a VRF
+ *
+ * If the removed paths were in use, the next best routes take over, which
+ * may be a prefix leaked into the VRF. Leaks are removed with
+ * routing_vrf_unleak_route().
+ *
+ * @param vrf_id VRF to remove the routes from
+ * @param prefix IP address prefix for the route
+ * @param prefix_len Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ * @param route_source Source whose paths are removed, NULL for every source
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+status_t routing_vrf_remove_route(uint16_t vrf_id, const ip_addr_t *prefix, uint8_t prefix_len,
+                                  ip_addr_type_t type, const route_source_t *route_source) {
+    status_t status;
+
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (!prefix || vrf_id >= ROUTING_MAX_VRFS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameters for routing_vrf_remove_route");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    ROUTING_LOCK();
+    status = rib_remove_route(vrf_id, prefix, prefix_len, type, route_source, ROUTE_VRF_NONE, false);
+    ROUTING_UNLOCK();
+    if (status != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_L3, "Route not found for deletion in VRF %u: %s/%u",
+                 vrf_id, route_addr_str(prefix, type), prefix_len);
+        return STATUS_NOT_FOUND;
+    }
+
+    if (route_source) {
+        LOG_INFO(LOG_CATEGORY_L3, "Removed route from VRF %u: %s/%u from source %d",
+                 vrf_id, route_addr_str(prefix, type), prefix_len, (int)*route_source);
+    } else {
+        LOG_INFO(LOG_CATEGORY_L3, "Removed route from VRF %u: %s/%u",
+                 vrf_id, route_addr_str(prefix, type), prefix_len);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Remove a route from the routing table
+ *
+ * Removes the routes of every source for the prefix.
+ *
+ * @param prefix IP address prefix for the route
+ * @param prefix_len Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+status_t routing_remove_route(const ip_addr_t *prefix, uint8_t prefix_len, ip_addr_type_t type) {
+    return routing_vrf_remove_route(ROUTING_VRF_DEFAULT, prefix, prefix_len, type, NULL);
+}
+
+/**
+ * @brief Remove the paths one source offers for a prefix
+ *
+ * If they were the paths in use, the next best routes take over.
+ *
+ * @param prefix IP address prefix for the route
+ * @param prefix_len Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ * @param route_source Source of the route
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+status_t routing_remove_route_source(const ip_addr_t *prefix, uint8_t prefix_len, ip_addr_type_t type,
+                                     route_source_t route_source) {
+    return routing_vrf_remove_route(ROUTING_VRF_DEFAULT, prefix, prefix_len, type, &route_source);
+}
+
+/**
+ * @brief Leak a prefix of one VRF into another
+ *
+ * The destination VRF forwards the prefix along whatever route the source
+ * VRF has installed for it, sharing its next-hop group, and follows it as
+ * it changes. A route of the destination VRF's own for the prefix takes
+ * precedence over the leak. Prefixes leaked into a VRF are not leaked on.
+ *
+ * @param src_vrf VRF the prefix is leaked from
+ * @param prefix IP address prefix
+ * @param prefix_len Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ * @param dst_vrf VRF the prefix is leaked into
+ * @return STATUS_SUCCESS if successful, STATUS_ALREADY_EXISTS if the prefix
+ *         is already leaked, error code otherwise
+ */
+status_t routing_vrf_leak_route(uint16_t src_vrf, const ip_addr_t *prefix, uint8_t prefix_len,
+                                ip_addr_type_t type, uint16_t dst_vrf) {
+    rib_route_t route;
+    status_t status;
+
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (!prefix || src_vrf >= ROUTING_MAX_VRFS || dst_vrf >= ROUTING_MAX_VRFS || src_vrf == dst_vrf) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameters for routing_vrf_leak_route");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(&route, 0, sizeof(route));
+    memcpy(&route.prefix, prefix, sizeof(ip_addr_t));
+    route.prefix_len = prefix_len;
+    route.addr_type = type;
+
+    ROUTING_LOCK();
+    if (!g_routing_table.vrfs[src_vrf] || !g_routing_table.vrfs[dst_vrf]) {
+        ROUTING_UNLOCK();
+        LOG_ERROR(LOG_CATEGORY_L3, "VRF %u or %u does not exist", src_vrf, dst_vrf);
+        return STATUS_NOT_FOUND;
+    }
+    status = rib_add_route(dst_vrf, &route, src_vrf);
+    ROUTING_UNLOCK();
+    if (status == STATUS_ALREADY_EXISTS) {
+        LOG_WARNING(LOG_CATEGORY_L3, "Route already leaked from VRF %u into VRF %u", src_vrf, dst_vrf);
+        return status;
+    }
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to leak route %s/%u from VRF %u into VRF %u",
+                  route_addr_str(prefix, type), prefix_len, src_vrf, dst_vrf);
+        return status;
+    }
+
+    LOG_INFO(LOG_CATEGORY_L3, "Leaked route %s/%u from VRF %u into VRF %u",
+             route_addr_str(prefix, type), prefix_len, src_vrf, dst_vrf);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Stop leaking a prefix of one VRF into another
+ *
+ * @param src_vrf VRF the prefix is leaked from
+ * @param prefix IP address prefix
+ * @param prefix_len Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ * @param dst_vrf VRF the prefix is leaked into
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+status_t routing_vrf_unleak_route(uint16_t src_vrf, const ip_addr_t *prefix, uint8_t prefix_len,
+                                  ip_addr_type_t type, uint16_t dst_vrf) {
+    status_t status;
+
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (!prefix || src_vrf >= ROUTING_MAX_VRFS || dst_vrf >= ROUTING_MAX_VRFS || src_vrf == dst_vrf) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameters for routing_vrf_unleak_route");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    ROUTING_LOCK();
+    status = rib_remove_route(dst_vrf, prefix, prefix_len, type, NULL, src_vrf, false);
+    ROUTING_UNLOCK();
+    if (status != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_L3, "Route %s/%u not leaked from VRF %u into VRF %u",
+                 route_addr_str(prefix, type), prefix_len, src_vrf, dst_vrf);
+        return STATUS_NOT_FOUND;
+    }
+
+    LOG_INFO(LOG_CATEGORY_L3, "Stopped leaking route %s/%u from VRF %u into VRF %u",
+             route_addr_str(prefix, type), prefix_len, src_vrf, dst_vrf);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Look up the best matching route for an IP address in a VRF
+ *
+ * For a prefix leaked into the VRF, the route of the source VRF is reported.
+ *
+ * @param vrf_id VRF to look in
+ * @param dest_addr Destination IP address to look up
+ * @param type IP address type (IPv4 or IPv6)
+ * @param[out] route_info Pointer to store route information if found
+ * @return STATUS_SUCCESS if a route is found, error code otherwise
+ */
+status_t routing_vrf_lookup(uint16_t vrf_id, const ip_addr_t *dest_addr, ip_addr_type_t type,
+                            route_entry_t *route_info) {
+    const rib_entry_t *entry;
+    rib_route_t info;
+
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (!dest_addr || !route_info || vrf_id >= ROUTING_MAX_VRFS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameters for routing_vrf_lookup");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (rcu_read_lock() != STATUS_SUCCESS) {
+        return STATUS_NO_MEMORY;
+    }
+
+    /* Perform longest prefix match lookup */
+    entry = fib_lookup_cached(vrf_id, dest_addr, type);
+    if (!entry) {
+        rcu_read_unlock();
+        LOG_DEBUG(LOG_CATEGORY_L3, "No route found for destination: %s",
+                  route_addr_str(dest_addr, type));
+        return STATUS_NOT_FOUND;
+    }
+
+    /* Copy route information */
+    info = entry->info;
+    rcu_read_unlock();
+    route_entry_from_rib(&info, route_info);
+
+    LOG_DEBUG(LOG_CATEGORY_L3, "Route found for %s: via %s, interface %u",
+              route_addr_str(dest_addr, type),
+              route_addr_str(&info.next_hop, type),
+              info.interface_index);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Look up the best matching route for an IP address
+ *
+ * @param dest_addr Destination IP address to look up
+ * @param type IP address type (IPv4 or IPv6)
+ * @param[out] route_info Pointer to store route information if found
+ * @return STATUS_SUCCESS if a route is found, error code otherwise
+ */
+status_t routing_lookup(const ip_addr_t *dest_addr, ip_addr_type_t type, route_entry_t *route_info) {
+    return routing_vrf_lookup(ROUTING_VRF_DEFAULT, dest_addr, type, route_info);
+}
+
+/**
+ * @brief Start a batch of routing table updates
+ *
+ * Until routing_table_commit_batch(), route changes update the RIB only;
+ * the FIB keeps forwarding along the routes installed before the batch
+ * and nothing is sent to hardware.
+ *
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+status_t routing_table_begin_batch(void) {
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    ROUTING_LOCK();
+    if (g_routing_table.batch_active) {
+        ROUTING_UNLOCK();
+        LOG_WARNING(LOG_CATEGORY_L3, "Routing batch already in progress");
+        return STATUS_RESOURCE_BUSY;
+    }
+
+    g_routing_table.batch_active = true;
+    ROUTING_UNLOCK();
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Add many routes given in the exported route form
+ *
+ * Runs inside the current batch, or in a batch of its own if none is open.
+ * Routes already present are skipped; one lock hold, no per-route logging.
+ *
+ * @param routes Routes to add
+ * @param count Number of routes
+ * @param[out] added Number of routes added, may be NULL
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+status_t routing_table_add_routes(const routing_route_t *routes, uint32_t count, uint32_t *added) {
+    status_t status;
+
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (!routes && count > 0) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameters for routing_table_add_routes");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    ROUTING_LOCK();
+    status = rib_add_route_list(routes, count, added);
+    ROUTING_UNLOCK();
+
+    return status;
+}
+
+/**
+ * @brief Add many routes to the routing table
+ *
+ * The batch API's name for routing_table_add_routes().
+ *
+ * @param routes Routes to add
+ * @param count Number of routes
+ * @param[out] added Number of routes added, may be NULL
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+status_t routing_add_routes_bulk(const routing_route_t *routes, uint32_t count, uint32_t *added) {
+    return routing_table_add_routes(routes, count, added);
+}
+
+/**
+ * @brief Add or remove many routes with a status for each
+ *
+ * The routes are applied with the table lock held once and, unless a
+ * batch is already open, reach the FIB in one commit at the end.
+ * Removals take the route's source into account.
+ *
+ * @param routes Routes to add or remove
+ * @param count Number of routes
+ * @param remove Remove the routes if true, add them otherwise
+ * @param stop_on_error Stop at the first route that fails
+ * @param[out] statuses Status of each route, may be NULL; STATUS_NOT_EXECUTED
+ *             for routes not tried
+ * @return STATUS_SUCCESS if every route was applied and committed,
+ *         otherwise the last error
+ */
+status_t routing_table_update_routes(const routing_route_t *routes, uint32_t count, bool remove,
+                                     bool stop_on_error, status_t *statuses) {
+    rib_route_t route;
+    bool own_batch;
+    uint32_t i = 0;
+    status_t result = STATUS_SUCCESS;
+
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (!routes && count > 0) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameters for routing_table_update_routes");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(&route, 0, sizeof(route));
+
+    ROUTING_LOCK();
+    own_batch = !g_routing_table.batch_active;
+    g_routing_table.batch_active = true;
+
+    while (i < count) {
+        status_t status;
+
+        if (remove) {
+            status = rib_remove_route(ROUTING_VRF_DEFAULT, &routes[i].prefix, routes[i].prefix_len,
+                                      routes[i].type, &routes[i].source, ROUTE_VRF_NONE, false);
+        } else {
+            route.prefix = routes[i].prefix;
+            route.next_hop = routes[i].next_hop;
+            route.prefix_len = routes[i].prefix_len;
+            route.interface_index = routes[i].interface_index;
+            route.metric = routes[i].metric;
+            route.addr_type = routes[i].type;
+            route.source = routes[i].source;
+            status = rib_add_route(ROUTING_VRF_DEFAULT, &route, ROUTE_VRF_NONE);
+        }
+
+        if (statuses) {
+            statuses[i] = status;
+        }
+        i++;
+        if (status != STATUS_SUCCESS) {
+            result = status;
+            if (stop_on_error) {
+                break;
+            }
+        }
+    }
+
+    if (own_batch) {
+        status_t commit_status = rib_commit_batch();
+        if (commit_status != STATUS_SUCCESS) {
+            result = commit_status;
+        }
+    }
+    ROUTING_UNLOCK();
+
+    if (statuses) {
+        for (; i < count; i++) {
+            statuses[i] = STATUS_NOT_EXECUTED;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @brief Add routes saved before a warm restart
+ *
+ * The routes forward at once but are stale: their source adding the same
+ * path again refreshes one, and routing_table_sweep_stale() removes the
+ * others.
+ *
+ * @param routes Routes to restore
+ * @param count Number of routes
+ * @param[out] added Number of routes added, may be NULL
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+status_t routing_table_restore_routes(const routing_route_t *routes, uint32_t count, uint32_t *added) {
+    status_t status;
+
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (!routes && count > 0) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameters for routing_table_restore_routes");
+        return STATUS_INVALID_PARAMETER;
     }
-}
 
+    ROUTING_LOCK();
+    g_routing_table.restoring = true;
+    status = rib_add_route_list(routes, count, added);
+    g_routing_table.restoring = false;
+    ROUTING_UNLOCK();
+
+    return status;
+}
 
+/**
+ * @brief Remove the restored routes no source has refreshed
+ *
+ * Called once the protocols have had time to reconverge after a warm
+ * restart. The removals reach the FIB in one batch commit.
+ *
+ * @param[out] removed Number of routes removed, may be NULL
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+status_t routing_table_sweep_stale(uint32_t *removed) {
+    rib_entry_t *head, *entry, *next_head;
+    ip_addr_t prefix;
+    uint32_t swept;
+    uint32_t i;
+    bool own_batch;
+    status_t status = STATUS_SUCCESS;
 
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
 
+    ROUTING_LOCK();
+    swept = g_routing_table.stale_count;
+    own_batch = !g_routing_table.batch_active;
+    g_routing_table.batch_active = true;
 
+    for (i = 0; i < g_routing_table.hash_size && g_routing_table.stale_count > 0; i++) {
+        for (head = g_routing_table.hash_table[i]; head; head = next_head) {
+            /* The removal may replace or unlink the head, the next prefix stays */
+            next_head = head->next;
+            for (entry = head; entry && !entry->stale; entry = entry->alt) {
+            }
+            if (entry) {
+                prefix = entry->info.prefix;
+                (void)rib_remove_route(entry->vrf_id, &prefix, entry->info.prefix_len,
+                                       entry->info.addr_type, NULL, ROUTE_VRF_NONE, true);
+            }
+        }
+    }
 
+    if (own_batch) {
+        status = rib_commit_batch();
+    }
+    swept -= g_routing_table.stale_count;
+    ROUTING_UNLOCK();
 
+    if (removed) {
+        *removed = swept;
+    }
 
+    LOG_INFO(LOG_CATEGORY_L3, "Swept %u stale routes", swept);
 
+    return status;
+}
 
-/* --- HARDWARE SYNCHRONIZATION --------------------------------------------- */
-static void sync_route_to_hw(const route_entry_t *entry, hw_operation_t operation);
+/**
+ * @brief Check whether a walk of the default VRF visits a candidate
+ */
+static inline bool rib_entry_walked(const rib_entry_t *entry) {
+    return entry->vrf_id == ROUTING_VRF_DEFAULT && entry->leak_vrf == ROUTE_VRF_NONE;
+}
 
 /**
- * @brief Synchronize a route with the hardware
+ * @brief Fill the exported form of a candidate
  *
- * @param entry Route entry to synchronize
- * @param operation Hardware operation (add or delete)
+ * @param entry Candidate
+ * @param route Receives the route
  */
-static void sync_route_to_hw(const route_entry_t *entry, hw_operation_t operation) {
-    hw_resource_t hw_resource;
-    
-    /* Set up the hardware resource */
-    hw_resource.type = HW_RESOURCE_TYPE_ROUTE;
-    memcpy(&hw_resource.route_entry, &entry->info, sizeof(routing_entry_t));
-    
-    /* Update the hardware */
-    if (operation == HW_OPERATION_ADD) {
-        hw_resource_add(&hw_resource);
-        LOG_DEBUG("Added route to hardware: %s/%d",
-                 (entry->info.addr_type == IP_ADDR_TYPE_V4) ? 
-                     inet_ntoa(*((struct in_addr *)&entry->info.prefix.v4)) : "IPv6",
-                 entry->info.prefix_len);
-    } else if (operation == HW_OPERATION_DELETE) {
-        hw_resource_delete(&hw_resource);
-        LOG_DEBUG("Deleted route from hardware: %s/%d",
-                 (entry->info.addr_type == IP_ADDR_TYPE_V4) ? 
-                     inet_ntoa(*((struct in_addr *)&entry->info.prefix.v4)) : "IPv6",
-                 entry->info.prefix_len);
-    }
+static void rib_entry_export(const rib_entry_t *entry, routing_route_t *route) {
+    route->prefix = entry->info.prefix;
+    route->next_hop = entry->info.next_hop;
+    route->type = entry->info.addr_type;
+    route->prefix_len = entry->info.prefix_len;
+    route->interface_index = entry->info.interface_index;
+    route->metric = entry->info.metric;
+    route->source = entry->info.source;
 }
 
-
-
-
 /**
- * @brief Insert a route into the routing table
+ * @brief Visit every route of the default VRF
  *
- * @param prefix IP address prefix for the route
- * @param prefix_len Prefix length
- * @param type IP address type (IPv4 or IPv6)
- * @param next_hop Next hop IP address
- * @param interface_index Outgoing interface index
- * @param metric Route metric
- * @param route_source Source of the route
+ * Every candidate is visited, not only the installed ones, so that a dump
+ * reloads into the same RIB. The routing lock is held throughout; the
+ * callback must not call back into the routing table.
+ *
+ * @param cb Called once per route
+ * @param ctx Passed to cb
  * @return STATUS_SUCCESS if successful, error code otherwise
  */
-status_t routing_add_route(const ip_addr_t *prefix, uint8_t prefix_len, ip_addr_type_t type,
-                         const ip_addr_t *next_hop, uint16_t interface_index,
-                         uint16_t metric, route_source_t route_source) {
-    uint32_t hash;
-    route_entry_t *new_entry;
+status_t routing_table_walk(routing_walk_cb_t cb, void *ctx) {
+    routing_route_t route;
+    rib_entry_t *head, *entry;
+    uint32_t i;
 
     if (!g_routing_initialized) {
-        LOG_ERROR("Routing table not initialized");
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
         return STATUS_NOT_INITIALIZED;
     }
 
-    if (!prefix || !next_hop) {
-        LOG_ERROR("Invalid parameters for routing_add_route");
-        return STATUS_INVALID_PARAMS;
+    if (!cb) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameters for routing_table_walk");
+        return STATUS_INVALID_PARAMETER;
     }
 
-    /* Validate prefix length */
-    if ((type == IP_ADDR_TYPE_V4 && prefix_len > 32) ||
-        (type == IP_ADDR_TYPE_V6 && prefix_len > 128)) {
-        LOG_ERROR("Invalid prefix length for route: %u", prefix_len);
-        return STATUS_INVALID_PARAMS;
-    }
+    memset(&route, 0, sizeof(route));
 
-    /* Check if route already exists */
-    if (find_route_exact(prefix, prefix_len, type) != NULL) {
-        LOG_WARN("Route already exists in the routing table");
-        return STATUS_ALREADY_EXISTS;
+    ROUTING_LOCK();
+    for (i = 0; i < g_routing_table.hash_size; i++) {
+        for (head = g_routing_table.hash_table[i]; head; head = head->next) {
+            for (entry = head; entry; entry = entry->alt) {
+                if (!rib_entry_walked(entry)) {
+                    continue;
+                }
+                rib_entry_export(entry, &route);
+                cb(&route, ctx);
+            }
+        }
     }
+    ROUTING_UNLOCK();
 
-    /* Check if we've reached the maximum number of routes */
-    if (g_routing_table.route_count >= MAX_ROUTES) {
-        LOG_ERROR("Routing table full, cannot add more routes");
-        return STATUS_RESOURCE_EXCEEDED;
-    }
+    return STATUS_SUCCESS;
+}
 
-    /* Allocate a new route entry */
-    new_entry = allocate_route_entry();
-    if (!new_entry) {
-        LOG_ERROR("Failed to allocate new route entry");
-        return STATUS_NO_MEMORY;
+/**
+ * @brief Copy the routes of one hash bucket that fall in a page
+ *
+ * Called with the routing lock held.
+ *
+ * @param bucket Bucket
+ * @param skip Routes of the bucket already returned
+ * @param routes Page, from its first free route
+ * @param room Routes the page has room for
+ * @return Routes of the bucket
+ */
+static uint32_t rib_page_bucket(uint32_t bucket, uint32_t skip, routing_route_t *routes, uint32_t room) {
+    rib_entry_t *head, *entry;
+    uint32_t n = 0;
+
+    for (head = g_routing_table.hash_table[bucket]; head; head = head->next) {
+        for (entry = head; entry; entry = entry->alt) {
+            if (!rib_entry_walked(entry)) {
+                continue;
+            }
+            if (n >= skip && n - skip < room) {
+                memset(&routes[n - skip], 0, sizeof(routes[n - skip]));
+                rib_entry_export(entry, &routes[n - skip]);
+            }
+            n++;
+        }
     }
 
-    /* Set route information */
-    memcpy(&new_entry->info.prefix, prefix, sizeof(ip_addr_t));
-    memcpy(&new_entry->info.next_hop, next_hop, sizeof(ip_addr_t));
-    new_entry->info.prefix_len = prefix_len;
-    new_entry->info.interface_index = interface_index;
-    new_entry->info.metric = metric;
-    new_entry->info.addr_type = type;
-    new_entry->info.source = route_source;
-    new_entry->info.flags = 0;  /* No flags by default */
-
-    /* Insert into hash table for exact match lookup */
-    if (type == IP_ADDR_TYPE_V4) {
-        hash = hash_ipv4_prefix(&prefix->v4, prefix_len);
-    } else {
-        hash = hash_ipv6_prefix(&prefix->v6, prefix_len);
+    return n;
+}
+
+/**
+ * @brief Get the next page of a walk of the default VRF
+ *
+ * Visits the routes routing_table_walk() does, in reverse binary order of
+ * the hash buckets (see table_cursor.h), so a rehash between two pages
+ * repeats routes rather than skipping them. The routing lock is held for
+ * one page only.
+ *
+ * @param cursor TABLE_CURSOR_START to begin; moved past the routes
+ *               returned, TABLE_CURSOR_END once the table is done
+ * @param routes Array to store the routes
+ * @param max_routes Size of the array
+ * @param count Receives the number of routes returned
+ * @return STATUS_SUCCESS if successful, error code otherwise
+ */
+status_t routing_table_get_routes_page(table_cursor_t *cursor, routing_route_t *routes, uint32_t max_routes,
+                                       uint32_t *count) {
+    table_cursor_t next;
+    uint32_t mask, v, skip, n = 0;
+
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
     }
 
-    hash %= ROUTE_HASH_SIZE;
-    new_entry->next = g_routing_table.hash_table[hash];
-    g_routing_table.hash_table[hash] = new_entry;
+    if (!cursor || !routes || max_routes == 0 || !count) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameters for routing_table_get_routes_page");
+        return STATUS_INVALID_PARAMETER;
+    }
 
-    /* Insert into LPM tree for longest prefix match lookup */
-    insert_to_lpm_tree(new_entry);
+    *count = 0;
+    if (*cursor == TABLE_CURSOR_END) {
+        return STATUS_SUCCESS;
+    }
 
-    /* Increment route count */
-    g_routing_table.route_count++;
+    ROUTING_LOCK();
+    mask = g_routing_table.hash_size - 1;
+    v = table_cursor_bucket(*cursor);
+    skip = table_cursor_skip(*cursor, mask);
 
-    LOG_INFO("Added route: %s/%u via interface %u",
-             ip_addr_to_str(prefix, type), prefix_len, interface_index);
+    /* Whole buckets while they fit; a bucket that fills an empty page alone is split */
+    for (;;) {
+        uint32_t size = rib_page_bucket(v & mask, skip, &routes[n], max_routes - n);
+        uint32_t left = size > skip ? size - skip : 0;
 
-    /* Sync to hardware if enabled */
-    if (g_routing_table.hw_sync_enabled) {
-        sync_route_to_hw(new_entry, HW_OP_ADD);
+        if (left > max_routes - n) {
+            if (n == 0) {
+                n = max_routes;
+                skip += max_routes;
+            }
+            next = table_cursor_make(v, mask, skip);
+            break;
+        }
+        n += left;
+        skip = 0;
+        v = table_cursor_next(v, mask);
+        if (v == 0) {
+            next = TABLE_CURSOR_END;
+            break;
+        }
+        if (n == max_routes) {
+            next = table_cursor_make(v, mask, 0);
+            break;
+        }
     }
+    ROUTING_UNLOCK();
 
+    *cursor = next;
+    *count = n;
     return STATUS_SUCCESS;
 }
 
 /**
- * @brief Remove a route from the routing table
+ * @brief Apply a batch of routing table updates
+ *
+ * Reinstalls each prefix changed during the batch once and sends the
+ * resulting hardware updates in one burst.
  *
- * @param prefix IP address prefix for the route
- * @param prefix_len Prefix length
- * @param type IP address type (IPv4 or IPv6)
  * @return STATUS_SUCCESS if successful, error code otherwise
  */
-status_t routing_remove_route(const ip_addr_t *prefix, uint8_t prefix_len, ip_addr_type_t type) {
-    uint32_t hash;
-    route_entry_t *entry, *prev = NULL;
+status_t routing_table_commit_batch(void) {
+    status_t status;
 
     if (!g_routing_initialized) {
-        LOG_ERROR("Routing table not initialized");
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
         return STATUS_NOT_INITIALIZED;
     }
 
-    if (!prefix) {
-        LOG_ERROR("Invalid parameter for routing_remove_route");
-        return STATUS_INVALID_PARAMS;
-    }
-
-    /* Calculate hash for the route */
-    if (type == IP_ADDR_TYPE_V4) {
-        hash = hash_ipv4_prefix(&prefix->v4, prefix_len);
-    } else {
-        hash = hash_ipv6_prefix(&prefix->v6, prefix_len);
+    ROUTING_LOCK();
+    if (!g_routing_table.batch_active) {
+        ROUTING_UNLOCK();
+        LOG_WARNING(LOG_CATEGORY_L3, "No routing batch in progress");
+        return STATUS_INVALID_PARAMETER;
     }
 
-    hash %= ROUTE_HASH_SIZE;
-
-    /* Find the route in the hash table */
-    for (entry = g_routing_table.hash_table[hash]; entry != NULL; prev = entry, entry = entry->next) {
-        if (entry->info.addr_type == type && entry->info.prefix_len == prefix_len &&
-            memcmp(&entry->info.prefix, prefix, sizeof(ip_addr_t)) == 0) {
-
-            /* Remove from hash table */
-            if (prev == NULL) {
-                g_routing_table.hash_table[hash] = entry->next;
-            } else {
-                prev->next = entry->next;
-            }
-
-            /* Remove from LPM tree */
-            remove_from_lpm_tree(entry);
-
-            /* Sync to hardware if enabled */
-            if (g_routing_table.hw_sync_enabled) {
-                sync_route_to_hw(entry, HW_OP_REMOVE);
-            }
+    status = rib_commit_batch();
+    ROUTING_UNLOCK();
 
-            LOG_INFO("Removed route: %s/%u",
-                     ip_addr_to_str(prefix, type), prefix_len);
+    LOG_INFO(LOG_CATEGORY_L3, "Committed routing batch: %u prefixes, %u routes",
+             g_routing_table.prefix_count, g_routing_table.route_count);
 
-            /* Free the route entry */
-            free_route_entry(entry);
+    return status;
+}
 
-            /* Decrement route count */
-            g_routing_table.route_count--;
+/**
+ * @brief Hash the 5-tuple of a flow for ECMP path selection
+ *
+ * Packets of one flow always hash alike, so they stay on one path.
+ *
+ * @param flow Flow fields
+ * @param type IP address type (IPv4 or IPv6)
+ * @return Flow hash
+ */
+uint32_t routing_flow_hash(const routing_flow_t *flow, ip_addr_type_t type) {
+    const uint8_t *src = route_addr_bytes(&flow->src_addr, type);
+    const uint8_t *dst = route_addr_bytes(&flow->dst_addr, type);
+    uint8_t len = (type == IP_TYPE_V4) ? IPV4_ADDR_LEN : IPV6_ADDR_LEN;
+    uint32_t hash = 2166136261U;
+    uint8_t i;
 
-            return STATUS_SUCCESS;
-        }
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ src[i]) * 16777619U;
+        hash = (hash ^ dst[i]) * 16777619U;
     }
+    hash = (hash ^ flow->protocol) * 16777619U;
+    hash = (hash ^ flow->src_port) * 16777619U;
+    hash = (hash ^ flow->dst_port) * 16777619U;
 
-    LOG_WARN("Route not found for deletion: %s/%u",
-             ip_addr_to_str(prefix, type), prefix_len);
+    /* Mix the high bits down so the bucket index uses all of them */
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6BU;
+    hash ^= hash >> 13;
 
-    return STATUS_NOT_FOUND;
+    return hash;
 }
 
 /**
- * @brief Look up the best matching route for an IP address
+ * @brief Resolve the next hop for a flow from the FIB of a VRF
+ *
+ * Forwarding path variant of routing_vrf_lookup() that does not touch the RIB.
+ * Among equal-cost paths the flow hash picks one; paths whose next hop is
+ * down are skipped.
  *
+ * @param vrf_id VRF to look in
  * @param dest_addr Destination IP address to look up
  * @param type IP address type (IPv4 or IPv6)
- * @param[out] route_info Pointer to store route information if found
+ * @param flow_hash Hash from routing_flow_hash()
+ * @param[out] next_hop Next hop IP address
+ * @param[out] interface_index Outgoing interface index
  * @return STATUS_SUCCESS if a route is found, error code otherwise
  */
-status_t routing_lookup(const ip_addr_t *dest_addr, ip_addr_type_t type, routing_entry_t *route_info) {
-    route_entry_t *entry;
+status_t routing_vrf_lookup_nexthop(uint16_t vrf_id, const ip_addr_t *dest_addr, ip_addr_type_t type,
+                                    uint32_t flow_hash, ip_addr_t *next_hop, uint16_t *interface_index) {
+    const rib_entry_t *entry;
+    uint32_t group_index = 0;
+    status_t status;
 
     if (!g_routing_initialized) {
-        LOG_ERROR("Routing table not initialized");
         return STATUS_NOT_INITIALIZED;
     }
 
-    if (!dest_addr || !route_info) {
-        LOG_ERROR("Invalid parameters for routing_lookup");
-        return STATUS_INVALID_PARAMS;
+    if (!dest_addr || !next_hop || !interface_index || vrf_id >= ROUTING_MAX_VRFS) {
+        return STATUS_INVALID_PARAMETER;
     }
 
-    /* Perform longest prefix match lookup */
-    entry = find_route_lpm(dest_addr, type);
-    if (!entry) {
-        LOG_DEBUG("No route found for destination: %s",
-                  ip_addr_to_str(dest_addr, type));
-        return STATUS_NOT_FOUND;
+    if (rcu_read_lock() != STATUS_SUCCESS) {
+        return STATUS_NO_MEMORY;
     }
 
-    /* Copy route information */
-    memcpy(route_info, &entry->info, sizeof(routing_entry_t));
+    entry = fib_lookup_cached(vrf_id, dest_addr, type);
+    if (entry) {
+        group_index = __atomic_load_n(&entry->group_index, __ATOMIC_ACQUIRE);
+    }
+    /* Withdrawn since it was found; the FIB has the current route */
+    if (entry && group_index == 0) {
+        group_index = fib_lookup_group(vrf_id, dest_addr, type);
+    }
+    if (group_index == 0) {
+        rcu_read_unlock();
+        return STATUS_NOT_FOUND;
+    }
 
-    LOG_DEBUG("Route found for %s: via %s, interface %u",
-              ip_addr_to_str(dest_addr, type),
-              ip_addr_to_str(&entry->info.next_hop, type),
-              entry->info.interface_index);
+    /* Not found as well when every path of the route is down */
+    status = nhgroup_select(group_index, flow_hash, next_hop, interface_index);
+    rcu_read_unlock();
 
-    return STATUS_SUCCESS;
+    return status;
 }
 
-
-
 /**
- * @brief Find a route entry with exact match
+ * @brief Resolve the next hop for a flow from the FIB only
  *
- * @param prefix IP address prefix to match
- * @param prefix_len Prefix length
+ * Forwarding path variant of routing_lookup() that does not touch the RIB.
+ * Among equal-cost paths the flow hash picks one; paths whose next hop is
+ * down are skipped.
+ *
+ * @param dest_addr Destination IP address to look up
  * @param type IP address type (IPv4 or IPv6)
- * @return Pointer to the matching route entry, or NULL if not found
+ * @param flow_hash Hash from routing_flow_hash()
+ * @param[out] next_hop Next hop IP address
+ * @param[out] interface_index Outgoing interface index
+ * @return STATUS_SUCCESS if a route is found, error code otherwise
  */
-static route_entry_t *find_route_exact(const ip_addr_t *prefix, uint8_t prefix_len, ip_addr_type_t type) {
-    uint32_t hash;
-    route_entry_t *entry;
-
-    /* Calculate hash for the route */
-    if (type == IP_ADDR_TYPE_V4) {
-        hash = hash_ipv4_prefix(&prefix->v4, prefix_len);
-    } else {
-        hash = hash_ipv6_prefix(&prefix->v6, prefix_len);
-    }
-
-    hash %= ROUTE_HASH_SIZE;
-
-    /* Search in the hash bucket */
-    for (entry = g_routing_table.hash_table[hash]; entry != NULL; entry = entry->next) {
-        if (entry->info.addr_type == type && entry->info.prefix_len == prefix_len &&
-            memcmp(&entry->info.prefix, prefix, sizeof(ip_addr_t)) == 0) {
-            return entry;
-        }
-    }
-
-    return NULL;  /* Not found */
+status_t routing_lookup_nexthop(const ip_addr_t *dest_addr, ip_addr_type_t type, uint32_t flow_hash,
+                                ip_addr_t *next_hop, uint16_t *interface_index) {
+    return routing_vrf_lookup_nexthop(ROUTING_VRF_DEFAULT, dest_addr, type, flow_hash,
+                                      next_hop, interface_index);
 }
 
 /**
- * @brief Insert a route entry into the LPM (Longest Prefix Match) tree
+ * @brief Look up the next-hop groups of a burst of addresses in a VRF
+ *
+ * Each trie level is fetched for the whole burst before the next one, with
+ * software prefetch, so the cache misses of up to ROUTING_LOOKUP_BULK_MAX
+ * lookups overlap. nh_index[i] names the next-hop group dst[i] is forwarded
+ * through; routing_nexthop_select() picks a path of it for a flow.
  *
- * @param entry Route entry to insert
+ * @param vrf_id VRF to look in
+ * @param dst Destination addresses
+ * @param n Number of addresses, at most ROUTING_LOOKUP_BULK_MAX
+ * @param type IP address type of every address
+ * @param[out] nh_index Next-hop group of each address, 0 if no route matches
+ * @param[out] miss_mask Bit i set if no route matches dst[i]
+ * @return STATUS_SUCCESS if successful, error code otherwise
  */
-static void insert_to_lpm_tree(route_entry_t *entry) {
-    route_entry_t **root;
-    route_entry_t *current, *parent = NULL;
-    bool go_right;
-    uint8_t bit_pos = 0;
+status_t routing_vrf_lookup_bulk(uint16_t vrf_id, const ip_addr_t *dst, uint32_t n, ip_addr_type_t type,
+                                 uint32_t *nh_index, uint64_t *miss_mask) {
+    const uint8_t *addrs[ROUTING_LOOKUP_BULK_MAX];
+    const rib_entry_t *entries[ROUTING_LOOKUP_BULK_MAX];
+    uint32_t leaves[ROUTING_LOOKUP_BULK_MAX];
+    const fib_vrf_t *vrf;
+    rib_chunk_t *const *chunks;
+    uint64_t misses = 0;
+    uint32_t i;
 
-    /* Select the appropriate LPM tree root based on address type */
-    if (entry->info.addr_type == IP_ADDR_TYPE_V4) {
-        root = &g_routing_table.lpm_root_v4;
-    } else {
-        root = &g_routing_table.lpm_root_v6;
+    if (!g_routing_initialized) {
+        return STATUS_NOT_INITIALIZED;
     }
 
-    /* If the tree is empty, make this entry the root */
-    if (*root == NULL) {
-        *root = entry;
-        entry->lpm_left = NULL;
-        entry->lpm_right = NULL;
-        return;
+    if ((!dst && n > 0) || !nh_index || !miss_mask || n > ROUTING_LOOKUP_BULK_MAX || vrf_id >= ROUTING_MAX_VRFS ||
+        (type != IP_TYPE_V4 && type != IP_TYPE_V6)) {
+        return STATUS_INVALID_PARAMETER;
     }
 
-    /* Traverse the tree to find the insertion point */
-    current = *root;
-    while (current != NULL) {
-        parent = current;
-
-        /* If we've checked all bits in the prefix, stop */
-        if (bit_pos >= entry->info.prefix_len) {
-            break;
-        }
+    if (rcu_read_lock() != STATUS_SUCCESS) {
+        return STATUS_NO_MEMORY;
+    }
 
-        /* Decide which branch to take based on the current bit */
-        go_right = get_bit_from_prefix(&entry->info.prefix, bit_pos, entry->info.addr_type);
+    /* A missing VRF has no routes; every address misses */
+    vrf = __atomic_load_n(&g_routing_table.vrfs[vrf_id], __ATOMIC_ACQUIRE);
+    for (i = 0; i < n; i++) {
+        addrs[i] = route_addr_bytes(&dst[i], type);
+        leaves[i] = LPM_LEAF_NONE;
+    }
+    if (vrf) {
+        lpm_trie_lookup_bulk((type == IP_TYPE_V4) ? &vrf->v4 : &vrf->v6, addrs, n, leaves);
+    }
 
-        if (go_right) {
-            current = current->lpm_right;
-        } else {
-            current = current->lpm_left;
+    /* Loaded after every leaf, as in find_route_lpm() */
+    chunks = __atomic_load_n(&g_routing_table.chunks, __ATOMIC_ACQUIRE);
+    for (i = 0; i < n; i++) {
+        if (leaves[i] != LPM_LEAF_NONE) {
+            entries[i] = rib_entry_at(chunks, leaves[i]);
+            __builtin_prefetch(&entries[i]->group_index);
         }
-
-        bit_pos++;
     }
 
-    /* Insert the new entry */
-    if (go_right) {
-        parent->lpm_right = entry;
-    } else {
-        parent->lpm_left = entry;
+    for (i = 0; i < n; i++) {
+        nh_index[i] = 0;
+        if (leaves[i] != LPM_LEAF_NONE) {
+            nh_index[i] = __atomic_load_n(&entries[i]->group_index, __ATOMIC_ACQUIRE);
+            if (nh_index[i] == 0) {
+                /* Withdrawn since its leaf was read */
+                nh_index[i] = fib_lookup_group(vrf_id, &dst[i], type);
+            }
+        }
+        if (nh_index[i] == 0) {
+            misses |= 1ULL << i;
+        }
     }
+    rcu_read_unlock();
+
+    *miss_mask = misses;
 
-    entry->lpm_left = NULL;
-    entry->lpm_right = NULL;
+    return STATUS_SUCCESS;
 }
 
 /**
- * @brief Remove a route entry from the LPM tree
+ * @brief Look up the next-hop groups of a burst of addresses
+ *
+ * Default VRF variant of routing_vrf_lookup_bulk().
  *
- * @param entry Route entry to remove
+ * @param dst Destination addresses
+ * @param n Number of addresses, at most ROUTING_LOOKUP_BULK_MAX
+ * @param type IP address type of every address
+ * @param[out] nh_index Next-hop group of each address, 0 if no route matches
+ * @param[out] miss_mask Bit i set if no route matches dst[i]
+ * @return STATUS_SUCCESS if successful, error code otherwise
  */
-static void remove_from_lpm_tree(route_entry_t *entry) {
-    /* This is a simplified implementation.
-     * In a production system, this would need to handle
-     * the rearrangement of the LPM tree after removal.
-     * For the simulator, we'll assume this is a managed tree
-     * where nodes can be marked as deleted without restructuring.
-     */
+status_t routing_lookup_bulk(const ip_addr_t *dst, uint32_t n, ip_addr_type_t type,
+                             uint32_t *nh_index, uint64_t *miss_mask) {
+    return routing_vrf_lookup_bulk(ROUTING_VRF_DEFAULT, dst, n, type, nh_index, miss_mask);
+}
+
+/**
+ * @brief Pick the path of a next-hop group for a flow
+ *
+ * The group index is one routing_lookup_bulk() returned; it stays valid
+ * until the route that led to it changes.
+ *
+ * @param nh_index Next-hop group index
+ * @param flow_hash Flow hash from routing_flow_hash()
+ * @param[out] next_hop Next hop address
+ * @param[out] interface_index Egress interface
+ * @return STATUS_SUCCESS, or STATUS_NOT_FOUND if every path of the group is down
+ */
+status_t routing_nexthop_select(uint32_t nh_index, uint32_t flow_hash,
+                                ip_addr_t *next_hop, uint16_t *interface_index) {
+    status_t status;
 
-    /* Mark the entry as removed by clearing its children */
-    entry->lpm_left = NULL;
-    entry->lpm_right = NULL;
+    if (!g_routing_initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
 
-    /* In a full implementation, we would need to:
-     * 1. Find the entry in the tree
-     * 2. Handle the case where the entry has 0, 1, or 2 children
-     * 3. Rebalance the tree if necessary
-     */
+    if (nh_index == 0 || !next_hop || !interface_index) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (rcu_read_lock() != STATUS_SUCCESS) {
+        return STATUS_NO_MEMORY;
+    }
 
-    LOG_DEBUG("Removed route entry from LPM tree (simplified implementation)");
+    if (nh_index > __atomic_load_n(&g_routing_table.group_next, __ATOMIC_ACQUIRE)) {
+        rcu_read_unlock();
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    status = nhgroup_select(nh_index, flow_hash, next_hop, interface_index);
+    rcu_read_unlock();
+
+    return status;
 }
 
 /**
- * @brief Find the best matching route using Longest Prefix Match
+ * @brief Mark a next hop reachable or unreachable
  *
- * @param addr IP address to match
+ * Updates the one shared next-hop object; every route through it follows.
+ * Groups containing it move only the flows of that path to their other
+ * paths, and back when it comes up again.
+ *
+ * @param next_hop Next hop IP address
  * @param type IP address type (IPv4 or IPv6)
- * @return Pointer to the best matching route entry, or NULL if not found
+ * @param interface_index Outgoing interface index
+ * @param up True if the next hop is reachable
+ * @return STATUS_SUCCESS if successful, STATUS_NOT_FOUND if no route uses it
  */
-static route_entry_t *find_route_lpm(const ip_addr_t *addr, ip_addr_type_t type) {
-    route_entry_t *current;
-    route_entry_t *best_match = NULL;
-    bool go_right;
-    uint8_t bit_pos = 0;
+status_t routing_set_nexthop_state(const ip_addr_t *next_hop, ip_addr_type_t type,
+                                   uint16_t interface_index, bool up) {
+    rib_route_t key;
+    fib_nexthop_t *nexthop = NULL;
+    fib_nhgroup_t *group;
+    uint32_t index;
+    uint32_t i;
+    uint8_t slot;
 
-    /* Select the appropriate LPM tree root based on address type */
-    if (type == IP_ADDR_TYPE_V4) {
-        current = g_routing_table.lpm_root_v4;
-    } else {
-        current = g_routing_table.lpm_root_v6;
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
     }
 
-    /* Traverse the tree to find the longest prefix match */
-    while (current != NULL) {
-        /* Check if the current node's prefix matches the address */
-        if (prefix_match(addr, &current->info.prefix, current->info.prefix_len, type)) {
-            /* Update best match if this prefix is longer */
-            if (best_match == NULL || current->info.prefix_len > best_match->info.prefix_len) {
-                best_match = current;
-            }
-        }
+    if (!next_hop) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameter for routing_set_nexthop_state");
+        return STATUS_INVALID_PARAMETER;
+    }
 
-        /* If we've reached a leaf node, stop */
-        if (bit_pos >=
-            ((type == IP_ADDR_TYPE_V4) ? 32 : 128)) {
+    memset(&key, 0, sizeof(key));
+    memcpy(&key.next_hop, next_hop, sizeof(ip_addr_t));
+    key.addr_type = type;
+    key.interface_index = interface_index;
+
+    ROUTING_LOCK();
+    for (index = g_routing_table.nexthop_hash[nexthop_hash(&key)]; index; index = nexthop->chain) {
+        nexthop = &g_routing_table.nexthops[index - 1];
+        if (nexthop_matches(nexthop, &key)) {
             break;
         }
+    }
 
-        /* Decide which branch to take based on the current bit in the address */
-        go_right = get_bit_from_prefix(addr, bit_pos, type);
+    if (index == 0) {
+        ROUTING_UNLOCK();
+        return STATUS_NOT_FOUND;
+    }
 
-        if (go_right) {
-            current = current->lpm_right;
-        } else {
-            current = current->lpm_left;
-        }
+    if (nexthop->up == up) {
+        ROUTING_UNLOCK();
+        return STATUS_SUCCESS;
+    }
+
+    nexthop->up = up;
 
-        bit_pos++;
+    for (i = 0; i < g_routing_table.group_next; i++) {
+        group = &g_routing_table.groups[i];
+        if (group->refcount == 0) {
+            continue;
+        }
+        if (group->backup == index) {
+            nhgroup_rebalance(group);
+            continue;
+        }
+        for (slot = 0; slot < group->member_count; slot++) {
+            if (group->members[slot] == index) {
+                nhgroup_rebalance(group);
+                break;
+            }
+        }
     }
+    /* Forwarding state cached on the old path is re-resolved */
+    fib_changed();
+    ROUTING_UNLOCK();
 
-    return best_match;
+    LOG_INFO(LOG_CATEGORY_L3, "Next hop %s via interface %u is %s",
+             route_addr_str(next_hop, type), interface_index, up ? "up" : "down");
+
+    return STATUS_SUCCESS;
 }
 
 /**
- * @brief Synchronize a route entry with hardware
+ * @brief Follow a batch of port link changes in the next hops
  *
- * @param entry Route entry to synchronize
- * @param operation Hardware operation (add/remove/update)
- */
-static void sync_route_to_hw(const route_entry_t *entry, hw_operation_t operation) {
-    hw_route_t hw_route;
-
-    /* Convert route entry to hardware format */
-    memset(&hw_route, 0, sizeof(hw_route_t));
-
-    hw_route.prefix = entry->info.prefix;
-    hw_route.prefix_len = entry->info.prefix_len;
-    hw_route.addr_type = entry->info.addr_type;
-    hw_route.next_hop = entry->info.next_hop;
-    hw_route.interface_index = entry->info.interface_index;
-    hw_route.metric = entry->info.metric;
-
-    /* Perform hardware operation */
-    switch (operation) {
-        case HW_OP_ADD:
-            LOG_DEBUG("Adding route to hardware: %s/%u",
-                     ip_addr_to_str(&entry->info.prefix, entry->info.addr_type),
-                     entry->info.prefix_len);
-            hw_add_route(&hw_route);
-            break;
+ * A next hop out of a port that lost link stops forwarding, and comes back
+ * with the link, the way routing_set_nexthop_state() switches it: every
+ * group using it moves its flows to the other members, or to its backup
+ * once none is left, before any route source has reacted.
+ *
+ * @param batch Changed ports
+ * @param arg Unused
+ */
+static void fib_link_batch(const link_event_batch_t *batch, void *arg) {
+    fib_nexthop_t *nexthop;
+    fib_nhgroup_t *group;
+    uint32_t changed = 0;
+    uint32_t i;
+    uint8_t slot;
+    bool down;
 
-        case HW_OP_REMOVE:
-            LOG_DEBUG("Removing route from hardware: %s/%u",
-                     ip_addr_to_str(&entry->info.prefix, entry->info.addr_type),
-                     entry->info.prefix_len);
-            hw_remove_route(&hw_route);
-            break;
+    (void)arg;
 
-        case HW_OP_UPDATE:
-            LOG_DEBUG("Updating route in hardware: %s/%u",
-                     ip_addr_to_str(&entry->info.prefix, entry->info.addr_type),
-                     entry->info.prefix_len);
-            hw_update_route(&hw_route);
-            break;
+    ROUTING_LOCK();
+    if (!g_routing_initialized) {
+        ROUTING_UNLOCK();
+        return;
+    }
 
-        default:
-            LOG_ERROR("Unknown hardware operation: %d", operation);
-            break;
+    for (i = 0; i < g_routing_table.nexthop_next; i++) {
+        nexthop = &g_routing_table.nexthops[i];
+        if (nexthop->refcount == 0 || !link_event_batch_has(batch, nexthop->interface_index)) {
+            continue;
+        }
+        down = !link_event_batch_up(batch, nexthop->interface_index);
+        if (nexthop->link_down != down) {
+            nexthop->link_down = down;
+            changed++;
+        }
+    }
+
+    if (changed > 0) {
+        for (i = 0; i < g_routing_table.group_next; i++) {
+            group = &g_routing_table.groups[i];
+            if (group->refcount == 0) {
+                continue;
+            }
+            if (group->backup &&
+                link_event_batch_has(batch, g_routing_table.nexthops[group->backup - 1].interface_index)) {
+                nhgroup_rebalance(group);
+                continue;
+            }
+            for (slot = 0; slot < group->member_count; slot++) {
+                if (link_event_batch_has(batch,
+                                         g_routing_table.nexthops[group->members[slot] - 1].interface_index)) {
+                    nhgroup_rebalance(group);
+                    break;
+                }
+            }
+        }
+        g_routing_table.nexthop_link_changes += changed;
+        fib_changed();
+    }
+    ROUTING_UNLOCK();
+
+    if (changed > 0) {
+        LOG_INFO(LOG_CATEGORY_L3, "%u next hops switched by %u port link changes", changed, batch->count);
     }
 }
 
 /**
- * @brief Allocate a route entry from the pre-allocated pool
+ * @brief Give the route of a source a loop-free alternate
+ *
+ * While the route is installed, the alternate is the backup of the
+ * prefix's next-hop group: once every path of the group is down, marked
+ * so by routing_set_nexthop_state() or by its port losing link, all flows
+ * move to the alternate at once, without waiting for the source to
+ * recompute. An alternate that is one of the paths is ignored. It goes
+ * away with the route.
  *
- * @return Pointer to an available route entry, or NULL if none available
+ * @param prefix IP address prefix
+ * @param prefix_len Prefix length
+ * @param type IP address type (IPv4 or IPv6)
+ * @param route_source Source of the route
+ * @param backup Next hop of the alternate, NULL to remove it
+ * @param interface_index Outgoing interface of the alternate
+ * @return STATUS_SUCCESS if successful, STATUS_NOT_FOUND if the source has
+ *         no route for the prefix, error code otherwise
  */
-static route_entry_t *allocate_route_entry(void) {
-    uint16_t i;
+status_t routing_set_backup_nexthop(const ip_addr_t *prefix, uint8_t prefix_len, ip_addr_type_t type,
+                                    route_source_t route_source, const ip_addr_t *backup,
+                                    uint16_t interface_index) {
+    rib_route_t key;
+    rib_entry_t *candidate;
+    rib_entry_t *head;
+    ip_addr_t masked;
+    uint32_t nh_index = 0;
+    bool found = false;
+    status_t status;
+
+    if (!g_routing_initialized) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Routing table not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
 
-    for (i = 0; i < MAX_ROUTES; i++) {
-        /* Check if entry is not in use (all zeroes) */
-        if (g_routing_table.route_pool[i].info.prefix_len == 0 &&
-            g_routing_table.route_pool[i].next == NULL) {
+    if (!prefix || (type != IP_TYPE_V4 && type != IP_TYPE_V6) ||
+        prefix_len > (type == IP_TYPE_V4 ? 32 : 128)) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Invalid parameter for routing_set_backup_nexthop");
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    masked = *prefix;
+    mask_prefix(&masked, prefix_len, type);
+    memset(&key, 0, sizeof(key));
+    if (backup) {
+        memcpy(&key.next_hop, backup, sizeof(ip_addr_t));
+    }
+    key.addr_type = type;
+    key.interface_index = interface_index;
+
+    ROUTING_LOCK();
+    head = find_route_exact(ROUTING_VRF_DEFAULT, &masked, prefix_len, type);
+    for (candidate = head; candidate; candidate = candidate->alt) {
+        if (candidate->leak_vrf != ROUTE_VRF_NONE || candidate->info.source != route_source) {
+            continue;
+        }
 
-            /* Clear the entry before returning it */
-            memset(&g_routing_table.route_pool[i], 0, sizeof(route_entry_t));
-            return &g_routing_table.route_pool[i];
+        /* The new reference first, in case it is the one being replaced */
+        if (backup) {
+            status = nexthop_get(&key, &nh_index);
+            if (status != STATUS_SUCCESS) {
+                ROUTING_UNLOCK();
+                return status;
+            }
         }
+        nexthop_put(candidate->backup_nh);
+        candidate->backup_nh = nh_index;
+        found = true;
     }
 
-    LOG_ERROR("No available route entries in pool");
-    return NULL;
-}
+    if (!found) {
+        ROUTING_UNLOCK();
+        return STATUS_NOT_FOUND;
+    }
 
-/**
- * @brief Free a route entry back to the pool
- *
- * @param entry Route entry to free
- */
-static void free_route_entry(route_entry_t *entry) {
-    /* Clear the entry to mark it as available */
-    memset(entry, 0, sizeof(route_entry_t));
+    /* The installed group is rebuilt with the backup, now or on commit */
+    if (g_routing_table.batch_active) {
+        rib_batch_mark(head);
+    } else if (rib_commit_prefix(head, NULL) != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Failed to install backup next hop outside of batch");
+    }
+    ROUTING_UNLOCK();
+
+    return STATUS_SUCCESS;
 }
 
 /**********************************************************************************/
@@ -12,17 +12,48 @@
 #include <signal.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include "common/logging.h"
 #include "common/types.h"
 #include "common/config.h"
+#include "common/event_bus.h"
+#include "common/event_loop.h"
+#include "common/event_task.h"
+#include "common/init_graph.h"
+#include "common/lock_stat.h"
+#include "common/mem_account.h"
+#include "common/sim_clock.h"
+#include "common/trace.h"
 #include "hal/hw_resources.h"
+#include "hal/forwarding.h"
+#include "hal/packet_profile.h"
+#include "hal/packet_drop.h"
+#include "hal/cpu_trap.h"
 #include "l2/mac_table.h"
 #include "l2/vlan.h"
+#include "l2/lag.h"
+#include "l2/mcast_snoop.h"
+#include "l2/storm_control.h"
+#include "l2/mirror.h"
+#include "hal/policer.h"
 #include "l3/routing_table.h"
+#include "l3/mcast_fib.h"
+#include "l3/mpls.h"
+#include "l3/conntrack.h"
+#include "l3/route_loader.h"
+#include "l3/icmp.h"
+#include "l3/punt.h"
+#include "l3/bfd.h"
 #include "management/cli.h"
 #include "management/stats.h"
+#include "management/warm_restart.h"
+#include "management/sflow.h"
+#include "management/mgmt_server.h"
+#include "management/config_model.h"
 #include "sai/sai_adapter.h"
+#include "pcap_driver.h"
+#include "workload.h"
 #include "bsp.h"
 
 
@@ -33,12 +64,372 @@ static volatile bool g_running = true;
 static volatile  cli_context_t    cli_ctx;
 static volatile  stats_context_t  stats_ctx;
 
+/* Таймер устаревания записей таблицы MAC-адресов */
+static event_timer_t g_mac_aging_timer;
+
+/* Таймер отправки ICMP-ошибок, поставленных в очередь потоками пересылки */
+static event_timer_t g_icmp_timer;
+
+/* Таймер LACP агрегированных каналов */
+static event_timer_t g_lacp_timer;
+
+/* Период таймера LACP, мкс */
+#define LACP_TIMER_INTERVAL_US 100000
+
+/* Файл маршрутов для загрузки при старте (-r) и файл образа для выгрузки при завершении (-d) */
+static const char *g_route_load_path = NULL;
+static const char *g_route_dump_path = NULL;
+
+/* Файл контрольной точки горячего перезапуска (-w) и период её записи в секундах (-W) */
+static const char *g_warm_restart_path = NULL;
+static uint32_t g_warm_restart_interval_s = 0;
+
+/* Имя сегмента разделяемой памяти для экспорта статистики (-s) */
+static const char *g_stats_shm_name = NULL;
+
+/* Сегмент истории счётчиков (-H) и период её выборки в мс (-I) */
+static const char *g_history_shm_name = NULL;
+static uint32_t g_history_interval_ms = 1000;
+
+/* Коллектор потоковой телеметрии host:port (-t) и период отправки в мс (-T) */
+static char *g_telemetry_target = NULL;
+static uint32_t g_telemetry_interval_ms = 250;
+
+/* Коллектор sFlow host:port (-f) и частота выборки 1 из N кадров на каждом порту (-F) */
+static char *g_sflow_target = NULL;
+static uint32_t g_sflow_rate = 4096;
+
+/* Адрес сервера управления [адрес:]порт (-m), NULL - сервер не запускается */
+static char *g_mgmt_listen = NULL;
+
+/* Длительность прогона на виртуальных часах в секундах (-v), 0 - реальное время */
+static uint32_t g_virtual_run_s = 0;
+
+/* Таймер завершения прогона на виртуальных часах */
+static event_timer_t g_virtual_run_timer;
+
+/* Сегмент разделяемой памяти с кольцом пакетов, перехваченных на CPU (-C) */
+static const char *g_cpu_trap_name = NULL;
+
+/* Файл конфигурации JSON, применяемый при старте (-c) */
+static const char *g_config_path = NULL;
+
+/* Запись принятого трафика в файл нагрузки (-R) */
+static const char *g_workload_record_path = NULL;
+
+/*
+ * Прогон записанной нагрузки (-p): темп (-P max, real или множитель скорости)
+ * и ожидаемый дайджест выходного трафика (-k)
+ */
+static const char *g_workload_replay_path = NULL;
+static pcap_replay_timing_t g_workload_timing = PCAP_REPLAY_MAX_RATE;
+static double g_workload_speed = 1.0;
+static bool g_workload_check = false;
+static uint64_t g_workload_expected = 0;
+
+/* Период проверки завершения прогона нагрузки, мкс */
+#define WORKLOAD_POLL_INTERVAL_US 100000
+
+/* Проверок без новых кадров на выходе, после которых прогон считается завершённым */
+#define WORKLOAD_QUIET_POLLS 3
+
+/**
+ * Состояние записи и прогона нагрузки
+ */
+static struct {
+    config_model_t config;          // Применённая конфигурация
+    bool configured;
+    pcap_replay_t *replay;
+    event_timer_t timer;
+    uint64_t start_ns;              // Начало прогона
+    uint64_t last_change_ns;        // Последний кадр на выходе
+    uint64_t last_packets;
+    uint32_t quiet_polls;
+    int exit_status;                // EXIT_FAILURE при несовпадении дайджеста
+} g_workload = { .exit_status = EXIT_SUCCESS };
+
+#if CONFIG_ENABLE_PIPELINE_PROFILING
+/**
+ * Команда CLI pipeline-profile: таблица задержек стадий конвейера,
+ * "pipeline-profile clear" обнуляет гистограммы,
+ * "pipeline-profile counters on|off" включает аппаратные счётчики стадий
+ */
+static status_t cli_pipeline_profile(int argc, char **argv, char *output, size_t output_len) {
+    if (argc > 1 && strcmp(argv[1], "clear") == 0) {
+        packet_profile_clear(PACKET_PROFILE_HISTOGRAMS);
+        snprintf(output, output_len, "Pipeline profile cleared\n");
+        return STATUS_SUCCESS;
+    }
+    if (argc > 2 && strcmp(argv[1], "counters") == 0) {
+        bool enable = strcmp(argv[2], "on") == 0;
+        status_t err = packet_profile_set_counters(enable);
+        if (err != STATUS_SUCCESS) {
+            snprintf(output, output_len, "Hardware performance counters are not available\n");
+            return err;
+        }
+        snprintf(output, output_len, "Pipeline hardware counters %s\n", enable ? "on" : "off");
+        return STATUS_SUCCESS;
+    }
+    packet_profile_report(output, output_len);
+    return STATUS_SUCCESS;
+}
+
+static const cli_command_t g_profile_command = {
+    .name = "pipeline-profile",
+    .help = "Show per-stage pipeline latency in cycles",
+    .usage = "pipeline-profile [clear | counters on|off]",
+    .handler = cli_pipeline_profile,
+};
+#endif
+
+#if CONFIG_SPINLOCK_STATS
+/**
+ * Команда CLI locks: ожидание и удержание спинлоков по классам,
+ * "locks clear" обнуляет счётчики
+ */
+static status_t cli_locks(int argc, char **argv, char *output, size_t output_len) {
+    if (argc > 1 && strcmp(argv[1], "clear") == 0) {
+        lock_stat_clear();
+        snprintf(output, output_len, "Lock statistics cleared\n");
+        return STATUS_SUCCESS;
+    }
+    lock_stat_report(output, output_len);
+    return STATUS_SUCCESS;
+}
+
+static const cli_command_t g_locks_command = {
+    .name = "locks",
+    .help = "Show spinlock contention by lock class",
+    .usage = "locks [clear]",
+    .handler = cli_locks,
+};
+#endif
+
+/**
+ * Команда CLI memory: память по подсистемам, куча и арены, с пиками,
+ * "memory clear" начинает пики заново с текущего объёма
+ */
+static status_t cli_memory(int argc, char **argv, char *output, size_t output_len) {
+    if (argc > 1 && strcmp(argv[1], "clear") == 0) {
+        mem_account_reset_peaks();
+        snprintf(output, output_len, "Memory high-water marks reset\n");
+        return STATUS_SUCCESS;
+    }
+    mem_account_report(output, output_len);
+    return STATUS_SUCCESS;
+}
+
+static const cli_command_t g_memory_command = {
+    .name = "memory",
+    .help = "Show memory footprint by subsystem",
+    .usage = "memory [clear]",
+    .handler = cli_memory,
+};
+
+/**
+ * Команда CLI event-bus: счётчики внутренней шины событий и её подписчиков
+ */
+static status_t cli_event_bus(int argc, char **argv, char *output, size_t output_len) {
+    (void)argc;
+    (void)argv;
+    event_bus_report(output, output_len);
+    return STATUS_SUCCESS;
+}
+
+static const cli_command_t g_event_bus_command = {
+    .name = "event-bus",
+    .help = "Show internal event bus subscribers and counters",
+    .usage = "event-bus",
+    .handler = cli_event_bus,
+};
+
+/**
+ * Команда CLI tasks: задачи плоскости управления и время их работы
+ */
+static status_t cli_tasks(int argc, char **argv, char *output, size_t output_len) {
+    (void)argc;
+    (void)argv;
+    event_task_report(output, output_len);
+    return STATUS_SUCCESS;
+}
+
+static const cli_command_t g_tasks_command = {
+    .name = "tasks",
+    .help = "Show control-plane tasks and their run time",
+    .usage = "tasks",
+    .handler = cli_tasks,
+};
+
+/**
+ * Дамп захваченных отбрасываний: по строке на запись и первые байты пакета
+ */
+static void cli_drops_capture(char *output, size_t output_len) {
+    static packet_drop_record_t records[CONFIG_PACKET_DROP_CAPTURE_SIZE];
+    uint32_t count = packet_drop_read_capture(records, CONFIG_PACKET_DROP_CAPTURE_SIZE);
+    size_t used = 0;
+    int n;
+
+    n = snprintf(output, output_len, "%u captured drops, 1 in %u sampled\n",
+                 count, packet_drop_get_sample_rate());
+    used = n > 0 ? (size_t)n : 0;
+
+    for (uint32_t i = 0; i < count && used < output_len; i++) {
+        const packet_drop_record_t *r = &records[i];
+
+        n = snprintf(output + used, output_len - used, "%llu.%09llu %-14s port %u vlan %u dir %u len %u ",
+                     (unsigned long long)(r->time_ns / 1000000000ULL),
+                     (unsigned long long)(r->time_ns % 1000000000ULL),
+                     packet_drop_reason_name((packet_drop_reason_t)r->reason),
+                     (unsigned)r->port, (unsigned)r->vlan, (unsigned)r->direction, r->length);
+        used += n > 0 ? (size_t)n : 0;
+        for (uint32_t b = 0; b < r->captured && used < output_len; b++) {
+            n = snprintf(output + used, output_len - used, "%02x", r->data[b]);
+            used += n > 0 ? (size_t)n : 0;
+        }
+        if (used < output_len) {
+            n = snprintf(output + used, output_len - used, "\n");
+            used += n > 0 ? (size_t)n : 0;
+        }
+    }
+}
+
+/**
+ * Команда CLI drops: счётчики отбрасываний по причинам,
+ * "drops capture" показывает захваченные пакеты, "drops sample N" задаёт
+ * частоту захвата (0 выключает), "drops clear" обнуляет счётчики и захват
+ */
+static status_t cli_drops(int argc, char **argv, char *output, size_t output_len) {
+    uint64_t counts[PACKET_DROP_REASON_COUNT];
+    uint64_t total = 0;
+    size_t used = 0;
+    int n;
+
+    if (argc > 1 && strcmp(argv[1], "capture") == 0) {
+        cli_drops_capture(output, output_len);
+        return STATUS_SUCCESS;
+    }
+    if (argc > 2 && strcmp(argv[1], "sample") == 0) {
+        char *end;
+        unsigned long rate = strtoul(argv[2], &end, 10);
+
+        if (end == argv[2] || *end != '\0' || rate > UINT32_MAX) {
+            snprintf(output, output_len, "Invalid sample rate: %s\n", argv[2]);
+            return STATUS_INVALID_PARAMETER;
+        }
+        packet_drop_set_sample_rate((uint32_t)rate);
+        snprintf(output, output_len, "Capturing 1 in %lu drops\n", rate);
+        return STATUS_SUCCESS;
+    }
+    if (argc > 1 && strcmp(argv[1], "clear") == 0) {
+        packet_drop_clear_counters();
+        packet_drop_clear_capture();
+        snprintf(output, output_len, "Drop counters and capture cleared\n");
+        return STATUS_SUCCESS;
+    }
+
+    if (packet_drop_get_counters(counts) != STATUS_SUCCESS) {
+        snprintf(output, output_len, "Drop counters not available\n");
+        return STATUS_NOT_INITIALIZED;
+    }
+    output[0] = '\0';
+    for (uint32_t r = PACKET_DROP_NONE + 1; r < PACKET_DROP_REASON_COUNT && used < output_len; r++) {
+        if (counts[r] == 0) {
+            continue;
+        }
+        total += counts[r];
+        n = snprintf(output + used, output_len - used, "%-16s %12llu\n",
+                     packet_drop_reason_name((packet_drop_reason_t)r), (unsigned long long)counts[r]);
+        used += n > 0 ? (size_t)n : 0;
+    }
+    if (used < output_len) {
+        snprintf(output + used, output_len - used, "%-16s %12llu\n", "total", (unsigned long long)total);
+    }
+    return STATUS_SUCCESS;
+}
+
+static const cli_command_t g_drops_command = {
+    .name = "drops",
+    .help = "Show drop counters by reason and captured drops",
+    .usage = "drops [capture | sample <N> | clear]",
+    .handler = cli_drops,
+};
+
+/**
+ * Команда CLI trace: включённые события и заполнение колец,
+ * "trace on|off <событие|all>" включает и выключает события,
+ * "trace dump <файл>" пишет кольца в файл для tools/scripts/trace_decode.py,
+ * "trace clear" очищает кольца
+ */
+static status_t cli_trace(int argc, char **argv, char *output, size_t output_len) {
+    uint64_t events = trace_get_events();
+    uint64_t recorded, lost;
+    size_t used = 0;
+    int n;
+
+    if (argc > 2 && (strcmp(argv[1], "on") == 0 || strcmp(argv[1], "off") == 0)) {
+        uint64_t mask = TRACE_ALL_EVENTS;
+        trace_event_t event;
+
+        if (strcmp(argv[2], "all") != 0) {
+            if (trace_event_from_name(argv[2], &event) != STATUS_SUCCESS) {
+                snprintf(output, output_len, "Unknown trace event: %s\n", argv[2]);
+                return STATUS_INVALID_PARAMETER;
+            }
+            mask = 1ULL << event;
+        }
+        if (strcmp(argv[1], "on") == 0) {
+            trace_enable(mask);
+        } else {
+            trace_disable(mask);
+        }
+        snprintf(output, output_len, "Tracing %s %s\n", argv[2], argv[1]);
+        return STATUS_SUCCESS;
+    }
+    if (argc > 2 && strcmp(argv[1], "dump") == 0) {
+        uint64_t written = 0;
+        status_t status = trace_dump(argv[2], &written);
+
+        if (status != STATUS_SUCCESS) {
+            snprintf(output, output_len, "Cannot write trace to %s (%d)\n", argv[2], (int)status);
+            return status;
+        }
+        snprintf(output, output_len, "%llu records written to %s\n", (unsigned long long)written, argv[2]);
+        return STATUS_SUCCESS;
+    }
+    if (argc > 1 && strcmp(argv[1], "clear") == 0) {
+        trace_clear();
+        snprintf(output, output_len, "Trace rings cleared\n");
+        return STATUS_SUCCESS;
+    }
+
+    trace_get_counts(&recorded, &lost);
+    output[0] = '\0';
+    for (uint32_t e = 0; e < TRACE_EVENT_COUNT && used < output_len; e++) {
+        n = snprintf(output + used, output_len - used, "%-14s %s\n",
+                     trace_event_name((trace_event_t)e), (events >> e) & 1 ? "on" : "off");
+        used += n > 0 ? (size_t)n : 0;
+    }
+    if (used < output_len) {
+        snprintf(output + used, output_len - used, "%llu records kept, %llu overwritten\n",
+                 (unsigned long long)recorded, (unsigned long long)lost);
+    }
+    return STATUS_SUCCESS;
+}
+
+static const cli_command_t g_trace_command = {
+    .name = "trace",
+    .help = "Control binary event tracing",
+    .usage = "trace [on <event|all> | off <event|all> | dump <file> | clear]",
+    .handler = cli_trace,
+};
+
 /**
  * Обработчик сигналов для корректного завершения работы
  */
 static void signal_handler(int signum) {
     LOG_INFO(LOG_CATEGORY_SYSTEM, "Получен сигнал %d, завершение работы...", signum);
     g_running = false;
+    event_loop_stop();
 }
 
 /**
@@ -63,51 +454,186 @@ static status_t setup_signal_handlers(void) {
 }
 
 /**
- * Инициализация всех компонентов симулятора
+ * Периодическая обработка устаревания таблицы MAC-адресов и групп IGMP/MLD
  */
-static status_t initialize_simulator(void) {
-    status_t err;
-    
-    bsp_error_t bsp_err;
+static void mac_aging_timer_cb(event_timer_t *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+    uint32_t now = (uint32_t)sim_clock_time();
 
-    // Инициализация платформы (BSP)
-    LOG_INFO(LOG_CATEGORY_BSP, "Инициализация платформы...");
+    mac_table_process_aging((mac_table_t*)mac_table_get_instance(), now);
+    mcast_snoop_process_timers(now);
+}
+
+/**
+ * Отправка LACPDU через порт-участник; кадр остаётся у вызывающего
+ */
+static void lacp_transmit(port_id_t port_id, packet_buffer_t *packet, void *arg) {
+    (void)arg;
+    (void)port_send_packet(port_id, packet);
+    packet_buffer_free(packet);
+}
+
+/**
+ * Периодические LACPDU и устаревание сведений о партнёрах
+ */
+static void lacp_timer_cb(event_timer_t *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+    lag_process_timers(sim_clock_now_us() / 1000, lacp_transmit, NULL);
+}
+
+/**
+ * Отправка ICMP-ошибок в потоке управления, а не в потоках пересылки
+ */
+static void icmp_timer_cb(event_timer_t *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+    icmp_process_errors(ICMP_DRAIN_BUDGET);
+}
+
+/**
+ * Завершение прогона на виртуальных часах по истечении заданного времени
+ */
+static void virtual_run_timer_cb(event_timer_t *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Прогон на виртуальных часах завершен: %u с", g_virtual_run_s);
+    g_running = false;
+    event_loop_stop();
+}
+
+/**
+ * Монотонное время в наносекундах, для замера прогона нагрузки
+ */
+static uint64_t workload_now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Проверка завершения прогона нагрузки: файл проигран, и выход затих на
+ * WORKLOAD_QUIET_POLLS проверок подряд. Итог пишется в журнал, дайджест
+ * сверяется с ожидаемым (-k), после чего симулятор останавливается
+ */
+static void workload_timer_cb(event_timer_t *timer, void *arg) {
+    pcap_replay_stats_t replay;
+    workload_digest_t digest;
+    uint64_t now = workload_now_ns();
+    (void)timer;
+    (void)arg;
+
+    pcap_replay_get_stats(g_workload.replay, &replay);
+    workload_digest_get(&digest);
+    if (digest.packets != g_workload.last_packets) {
+        g_workload.last_packets = digest.packets;
+        g_workload.last_change_ns = now;
+        g_workload.quiet_polls = 0;
+        return;
+    }
+    if (!replay.done || ++g_workload.quiet_polls < WORKLOAD_QUIET_POLLS) {
+        return;
+    }
+
+    uint64_t end = g_workload.last_change_ns > g_workload.start_ns ? g_workload.last_change_ns : now;
+    double seconds = (double)(end - g_workload.start_ns) / 1e9;
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Прогон нагрузки: %llu кадров на входе (%llu потеряно) за %.3f с, "
+             "%.0f кадров/с", (unsigned long long)replay.packets, (unsigned long long)replay.dropped,
+             seconds, seconds > 0 ? (double)replay.packets / seconds : 0.0);
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Выход: %llu кадров, %llu байт, дайджест %016llx",
+             (unsigned long long)digest.packets, (unsigned long long)digest.bytes,
+             (unsigned long long)digest.value);
+    if (g_workload_check && digest.value != g_workload_expected) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Дайджест выхода %016llx не совпадает с ожидаемым %016llx",
+                  (unsigned long long)digest.value, (unsigned long long)g_workload_expected);
+        g_workload.exit_status = EXIT_FAILURE;
+    }
 
-    // Создаем конфигурацию BSP
+    event_timer_stop(&g_workload.timer);
+    g_running = false;
+    event_loop_stop();
+}
+
+/**
+ * Общее состояние шагов запуска: конфигурация платы нужна нескольким шагам,
+ * а таблица маршрутизации и контекст оборудования должны пережить запуск
+ */
+static struct {
     bsp_config_t bsp_config;
-//    char temp_name[] = "Medium Switch";
-    
-//    // Используем одну из преднастроенных конфигураций, например, MEDIUM
-//    bsp_config.board_type = BSP_BOARD_TYPE_MEDIUM;
-//    bsp_config.num_ports = 24;
-//    bsp_config.cpu_frequency_mhz = 800;
-//    bsp_config.memory_size_mb = 512;
-//    bsp_config.has_layer3_support = true;
-//    bsp_config.has_qos_support = true;
-//    bsp_config.has_acl_support = true;
-//    bsp_config.board_name = temp_name;
+    routing_table_t routing_table;
+    hw_context_t hw_context;
+} g_startup;
+
+/**
+ * Шаги запуска; шаг зависит только от шагов с меньшими номерами
+ */
+enum {
+    INIT_STEP_BSP,
+    INIT_STEP_HAL,
+    INIT_STEP_MAC,
+    INIT_STEP_VLAN,
+    INIT_STEP_LAG,
+    INIT_STEP_MCAST,
+    INIT_STEP_STORM,
+    INIT_STEP_MIRROR,
+    INIT_STEP_MPLS,
+    INIT_STEP_CONNTRACK,
+    INIT_STEP_POLICER,
+    INIT_STEP_ROUTING,
+    INIT_STEP_WARM_RESTART,
+    INIT_STEP_SAI,
+    INIT_STEP_FORWARDING,
+    INIT_STEP_EVENTS,
+    INIT_STEP_STATS,
+    INIT_STEP_CLI,
+    INIT_STEP_WORKLOAD,
+    INIT_STEP_COUNT
+};
+
+/**
+ * Инициализация платформы (BSP)
+ */
+static status_t init_step_bsp(void *arg) {
+    status_t err;
+    bsp_error_t bsp_err;
+    (void)arg;
 
+    LOG_INFO(LOG_CATEGORY_BSP, "Инициализация платформы...");
 
     // Инициализируем конфигурацию с предустановками
-    bsp_err = bsp_init_config(&bsp_config, BSP_BOARD_TYPE_MEDIUM);
+    bsp_err = bsp_init_config(&g_startup.bsp_config, CONFIG_BOARD_TYPE);
     if (bsp_err != BSP_SUCCESS) {
         LOG_ERROR(LOG_CATEGORY_BSP, "Ошибка инициализации конфигурации BSP: %d", bsp_err);
         return BSP_ERROR_INIT_FAILED;
     }
 
+    // Порты платы должны уместиться в таблицы, размеры которых заданы при сборке
+    if (g_startup.bsp_config.num_ports > CONFIG_VXLAN_PORT_BASE) {
+        LOG_ERROR(LOG_CATEGORY_BSP, "Плата имеет %u портов, сборка рассчитана на %u",
+                  g_startup.bsp_config.num_ports, (unsigned)CONFIG_VXLAN_PORT_BASE);
+        return STATUS_INVALID_PARAMETER;
+    }
 
     // Можно дополнительно изменить имя платы, если нужно
-    bsp_set_board_name(&bsp_config, "Custom Medium Switch");
+    bsp_set_board_name(&g_startup.bsp_config, "Custom Medium Switch");
 
-    
-    // Теперь передаем указатель на конфигурацию
-    err = bsp_init(&bsp_config);
+    err = bsp_init(&g_startup.bsp_config);
     if (err != STATUS_SUCCESS) {
         LOG_ERROR(LOG_CATEGORY_BSP, "Ошибка инициализации платформы: %d", err);
         return err;
     }
-    
-    // Инициализация аппаратных ресурсов (HAL)
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Инициализация аппаратных ресурсов (HAL)
+ */
+static status_t init_step_hal(void *arg) {
+    status_t err;
+    (void)arg;
+
     LOG_INFO(LOG_CATEGORY_HAL, "Инициализация аппаратных ресурсов...");
     err = hw_resources_init();
     if (err != STATUS_SUCCESS) {
@@ -115,6 +641,33 @@ static status_t initialize_simulator(void) {
         return err;
     }
 
+    // Бюджеты ACL, счетчиков и очередей — по пулам ресурсов платы
+    const bsp_resource_pool_profile_t *res = g_startup.bsp_config.resources;
+    hw_resources_set_total(HW_RESOURCE_ACL, res[BSP_RESOURCE_TYPE_TCAM_SLICE].count *
+                                            res[BSP_RESOURCE_TYPE_TCAM_SLICE].entries);
+    hw_resources_set_total(HW_RESOURCE_COUNTER, res[BSP_RESOURCE_TYPE_COUNTER_BANK].count *
+                                                res[BSP_RESOURCE_TYPE_COUNTER_BANK].entries);
+    hw_resources_set_total(HW_RESOURCE_QUEUE, res[BSP_RESOURCE_TYPE_QUEUE].count);
+
+    // Кольцо открывается до пути punt, чтобы первые же пакеты попали к внешним потребителям
+    if (g_cpu_trap_name != NULL) {
+        err = cpu_trap_open(g_cpu_trap_name, 0, 0);
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_HAL, "Ошибка создания кольца перехвата на CPU: %d", err);
+            return err;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Таблица MAC-адресов с раскладкой хеш-банков из профиля платы
+ */
+static status_t init_step_mac(void *arg) {
+    const bsp_config_t *bsp_config = &g_startup.bsp_config;
+    status_t err;
+    (void)arg;
+
     // Создаем конфигурацию для таблицы MAC-адресов
     mac_table_config_t mac_config;
 
@@ -124,6 +677,20 @@ static status_t initialize_simulator(void) {
     mac_config.max_entries = 8192;             // Максимальное количество записей в таблице
     mac_config.move_detection = true;          // Включаем обнаружение перемещения MAC-адресов
 
+    // Раскладка хеш-банков ASIC из профиля платы
+    mac_table_hw_profile_t mac_hw_profile = {
+        .mode = bsp_config->mac_table.mode == BSP_MAC_TABLE_MODE_BANKED ?
+                MAC_TABLE_MODE_BANKED : MAC_TABLE_MODE_CUCKOO,
+        .banks = bsp_config->mac_table.banks,
+        .rows = bsp_config->mac_table.rows_per_bank,
+        .ways = bsp_config->mac_table.ways,
+        .overflow = bsp_config->mac_table.overflow_per_bank,
+    };
+    if (mac_hw_profile.mode == MAC_TABLE_MODE_BANKED) {
+        mac_config.max_entries = mac_hw_profile.banks *
+            (mac_hw_profile.rows * mac_hw_profile.ways + mac_hw_profile.overflow);
+    }
+
     // Инициализация L2 компонентов
     LOG_INFO(LOG_CATEGORY_L2, "Инициализация L2 компонентов...");
 //    err = mac_table_init(&mac_config);
@@ -132,53 +699,338 @@ static status_t initialize_simulator(void) {
         LOG_ERROR(LOG_CATEGORY_L2, "Ошибка инициализации таблицы MAC-адресов: %d", err);
         return err;
     }
-    
-    err = vlan_init(bsp_config.num_ports);
+
+    err = mac_table_set_hw_profile(&mac_hw_profile);
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Ошибка настройки хеш-банков таблицы MAC-адресов: %d", err);
+        return err;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Таблица VLAN на все порты платы
+ */
+static status_t init_step_vlan(void *arg) {
+    status_t err;
+    (void)arg;
+
+    err = vlan_init(g_startup.bsp_config.num_ports);
     if (err != STATUS_SUCCESS) {
         LOG_ERROR(LOG_CATEGORY_L2, "Ошибка инициализации VLAN: %d", err);
         return err;
     }
-    
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Агрегирование каналов (LAG/LACP)
+ */
+static status_t init_step_lag(void *arg) {
+    status_t err;
+    (void)arg;
+
+    err = lag_init();
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Ошибка инициализации агрегирования каналов: %d", err);
+        return err;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Отслеживание групп IGMP/MLD (snooping)
+ */
+static status_t init_step_mcast(void *arg) {
+    status_t err;
+    (void)arg;
+
+    err = mcast_snoop_init(0);
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Ошибка инициализации IGMP/MLD snooping: %d", err);
+        return err;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Контроль штормов
+ */
+static status_t init_step_storm(void *arg) {
+    status_t err;
+    (void)arg;
+
+    err = storm_control_init();
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Ошибка инициализации контроля штормов: %d", err);
+        return err;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Зеркалирование портов и VLAN
+ */
+static status_t init_step_mirror(void *arg) {
+    status_t err;
+    (void)arg;
+
+    err = mirror_init();
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L2, "Ошибка инициализации зеркалирования: %d", err);
+        return err;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Коммутация по меткам MPLS; LFIB заполняется конфигурацией
+ */
+static status_t init_step_mpls(void *arg) {
+    status_t err;
+    (void)arg;
+
+    err = mpls_init();
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Ошибка инициализации коммутации MPLS: %d", err);
+        return err;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Отслеживание соединений и NAT; выключено, пока его не включит конфигурация
+ */
+static status_t init_step_conntrack(void *arg) {
+    status_t err;
+    (void)arg;
+
+    err = conntrack_init();
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Ошибка инициализации отслеживания соединений: %d", err);
+        return err;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Полисеры srTCM/trTCM портов, VLAN и правил ACL; создаются конфигурацией
+ */
+static status_t init_step_policer(void *arg) {
+    status_t err;
+    (void)arg;
+
+    err = policer_init();
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Ошибка инициализации полисеров: %d", err);
+        return err;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Таблица маршрутизации и массовая загрузка маршрутов
+ */
+static status_t init_step_routing(void *arg) {
+    routing_table_t *routing_table = &g_startup.routing_table;
+    status_t err;
+    (void)arg;
+
     // Создаем таблицу маршрутизации и инициализируем её базовыми значениями
-    routing_table_t routing_table;
+    routing_table->route_count = 0;         // Изначально таблица пуста
+    routing_table->last_update_time = 0;    // Время последнего обновления
+    routing_table->changed = false;         // Флаг изменения
 
-    routing_table.route_count = 0;         // Изначально таблица пуста
-    routing_table.last_update_time = 0;    // Время последнего обновления
-    routing_table.changed = false;         // Флаг изменения
-    
-    // Инициализируем таблицу маршрутизации
     // Инициализация L3 компонентов
     LOG_INFO(LOG_CATEGORY_L3, "Инициализация L3 компонентов...");
-    err = routing_table_init(&routing_table);
+    err = routing_table_init(routing_table);
     if (err != STATUS_SUCCESS) {
         LOG_ERROR(LOG_CATEGORY_L3, "Ошибка инициализации таблицы маршрутизации: %d", err);
         return err;
     }
-    
+
+    // Таблица многоадресной маршрутизации, её заполняет PIM или статическая конфигурация
+    err = mfib_init(0);
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Ошибка инициализации таблицы многоадресной маршрутизации: %d", err);
+        return err;
+    }
+
+    // Массовая загрузка маршрутов (MRT или образ таблицы) одним пакетом
+    if (g_route_load_path != NULL) {
+        err = route_loader_load(g_route_load_path, NULL, NULL);
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_L3, "Ошибка загрузки маршрутов из %s: %d", g_route_load_path, err);
+            return err;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Горячий перезапуск: маршруты, ARP и MAC из контрольной точки, до обновления протоколами
+ */
+static status_t init_step_warm_restart(void *arg) {
+    warm_restart_config_t warm_config;
+    status_t err;
+    (void)arg;
+
+    if (g_warm_restart_path == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    warm_restart_get_default_config(&warm_config);
+    warm_config.checkpoint_interval_ms = g_warm_restart_interval_s * 1000u;
+    err = warm_restart_init(g_warm_restart_path, &warm_config);
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Ошибка настройки горячего перезапуска: %d", err);
+        return err;
+    }
+    // Нет годной контрольной точки - обычный холодный старт
+    (void)warm_restart_restore(NULL);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Контекст оборудования и SAI
+ */
+static status_t init_step_sai(void *arg) {
+    hw_context_t *hw_context = &g_startup.hw_context;
+    status_t err;
+    (void)arg;
+
     // Создаем и инициализируем контекст оборудования
-    hw_context_t hw_context;
-    memset(&hw_context, 0, sizeof(hw_context_t)); // Сначала обнуляем всю структуру
+    memset(hw_context, 0, sizeof(hw_context_t)); // Сначала обнуляем всю структуру
     
     // Инициализация полей структуры
-    hw_context.hw_registers = NULL;                     // Или выделите память, если это необходимо
-    hw_context.port_count = CONFIG_DEFAULT_PORT_COUNT;  // Используйте константу из конфигурации
-    hw_context.is_initialized = false;                  // Устанавливаем false, т.к. инициализация еще не завершена
-    hw_context.device_handle = NULL;                    // Будет установлено позже драйвером устройства
-    hw_context.dma_memory = NULL;                       // Или выделите память для DMA операций
-    hw_context.device_id = 0;                           // Или используйте соответствующий ID устройства
+    hw_context->hw_registers = NULL;                     // Или выделите память, если это необходимо
+    hw_context->port_count = CONFIG_DEFAULT_PORT_COUNT;  // Используйте константу из конфигурации
+    hw_context->is_initialized = false;                  // Устанавливаем false, т.к. инициализация еще не завершена
+    hw_context->device_handle = NULL;                    // Будет установлено позже драйвером устройства
+    hw_context->dma_memory = NULL;                       // Или выделите память для DMA операций
+    hw_context->device_id = 0;                           // Или используйте соответствующий ID устройства
     
     // Инициализация мьютекса
-    pthread_mutex_init(&hw_context.hw_mutex, NULL);
+    pthread_mutex_init(&hw_context->hw_mutex, NULL);
 
     // Инициализация SAI
     LOG_INFO(LOG_CATEGORY_SAI, "Инициализация SAI...");
     //err = sai_adapter_init(&hw_context.hw_mutex, NULL);
-    err = sai_adapter_init(&hw_context);
+    err = sai_adapter_init(hw_context);
     if (err != STATUS_SUCCESS) {
         LOG_ERROR(LOG_CATEGORY_SAI, "Ошибка инициализации SAI адаптера: %d", err);
         return err;
     }
-    
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Запуск пула потоков пересылки (CONFIG_WORKER_THREADS, 0 - по числу ядер)
+ */
+static status_t init_step_forwarding(void *arg) {
+    status_t err;
+    (void)arg;
+
+    // Пакеты к коммутатору идут в кольцо перехвата через поток punt
+    if (g_cpu_trap_name != NULL) {
+        err = punt_init();
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_L3, "Ошибка запуска пути punt: %d", err);
+            return err;
+        }
+    }
+
+    LOG_INFO(LOG_CATEGORY_HAL, "Запуск потоков пересылки пакетов...");
+    err = forwarding_init(NULL);
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_HAL, "Ошибка запуска потоков пересылки: %d", err);
+        return err;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Цикл событий и периодические таймеры
+ */
+static status_t init_step_events(void *arg) {
+    status_t err;
+    (void)arg;
+
+    err = event_loop_init();
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Ошибка инициализации цикла событий: %d", err);
+        return err;
+    }
+
+    // Шина событий раздаёт события модулям пачками из цикла событий
+    err = event_bus_init();
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Ошибка инициализации шины событий: %d", err);
+        return err;
+    }
+
+    // Задачи плоскости управления выполняются в потоке цикла событий,
+    // закреплённом за CONFIG_CONTROL_PLANE_CPU
+    err = event_task_init(CONFIG_CONTROL_PLANE_CPU);
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Ошибка инициализации задач плоскости управления: %d", err);
+        return err;
+    }
+
+    event_timer_init(&g_mac_aging_timer, mac_aging_timer_cb, NULL);
+    err = event_timer_start(&g_mac_aging_timer, 1000000, 1000000);
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Ошибка запуска таймера устаревания MAC: %d", err);
+        return err;
+    }
+
+    event_timer_init(&g_lacp_timer, lacp_timer_cb, NULL);
+    err = event_timer_start(&g_lacp_timer, LACP_TIMER_INTERVAL_US, LACP_TIMER_INTERVAL_US);
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Ошибка запуска таймера LACP: %d", err);
+        return err;
+    }
+
+    event_timer_init(&g_icmp_timer, icmp_timer_cb, NULL);
+    err = event_timer_start(&g_icmp_timer, ICMP_DRAIN_INTERVAL_US, ICMP_DRAIN_INTERVAL_US);
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Ошибка запуска таймера отправки ICMP: %d", err);
+        return err;
+    }
+
+    if (g_virtual_run_s > 0) {
+        event_timer_init(&g_virtual_run_timer, virtual_run_timer_cb, NULL);
+        err = event_timer_start(&g_virtual_run_timer, (uint64_t)g_virtual_run_s * 1000000, 0);
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Ошибка запуска таймера прогона: %d", err);
+            return err;
+        }
+    }
+
+    if (g_warm_restart_path != NULL) {
+        err = warm_restart_start();
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Ошибка запуска таймеров горячего перезапуска: %d", err);
+            return err;
+        }
+    }
+
+    // Сеансы BFD живут на таймерах цикла событий, пакеты приходят через punt
+    err = bfd_init();
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_L3, "Ошибка инициализации BFD: %d", err);
+        return err;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Статистика, её экспорт в разделяемую память и телеметрия
+ */
+static status_t init_step_stats(void *arg) {
+    status_t err;
+    (void)arg;
+
     // Создаем переменную контекста статистики и обнуляем её
     memset((void*)&stats_ctx, 0, sizeof(stats_ctx));
 
@@ -190,6 +1042,90 @@ static status_t initialize_simulator(void) {
         return err;
     }
 
+    // Счётчики в разделяемой памяти обновляются потоком сбора статистики
+    if (g_stats_shm_name != NULL) {
+        err = stats_enable_shm_export((void*)&stats_ctx, g_stats_shm_name);
+        if (err == STATUS_SUCCESS) {
+            err = stats_enable_periodic_collection((void*)&stats_ctx, 1000);
+        }
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_CONTROL, "Ошибка экспорта статистики в %s: %d", g_stats_shm_name, err);
+            return err;
+        }
+    }
+
+    // История счётчиков портов, очередей и маршрутизации со скоростями изменения;
+    // VLAN не входят: 4096 кольцевых буферов на каждый счётчик слишком дороги
+    if (g_history_shm_name != NULL) {
+        stats_history_config_t history_config = {
+            .name = g_history_shm_name,
+            .interval_ms = g_history_interval_ms,
+            .depth = STATS_HISTORY_DEFAULT_DEPTH,
+            .objects = TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_PORT) | TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_QUEUE) |
+                       TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_ROUTING),
+        };
+        err = stats_enable_history((void*)&stats_ctx, &history_config);
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_CONTROL, "Ошибка запуска истории счётчиков в %s: %d", g_history_shm_name, err);
+            return err;
+        }
+    }
+
+    // Телеметрия отправляет только изменившиеся счётчики; опорный кадр раз в 10 с
+    if (g_telemetry_target != NULL) {
+        char *colon = strrchr(g_telemetry_target, ':');
+        telemetry_config_t telemetry_config = {
+            .host = g_telemetry_target,
+            .port = 0,
+            .interval_ms = g_telemetry_interval_ms,
+            .subscriptions = TELEMETRY_SUBSCRIBE_ALL,
+            .keyframe_every = g_telemetry_interval_ms ? 10000 / g_telemetry_interval_ms : 0,
+        };
+        if (colon != NULL) {
+            *colon = '\0';
+            telemetry_config.port = (uint16_t)strtoul(colon + 1, NULL, 10);
+        }
+        err = stats_enable_telemetry((void*)&stats_ctx, &telemetry_config);
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_CONTROL, "Ошибка запуска телеметрии: %d", err);
+            return err;
+        }
+    }
+
+    // sFlow: случайная выборка кадров на входе всех портов и опрос их счётчиков
+    if (g_sflow_target != NULL) {
+        char *colon = strrchr(g_sflow_target, ':');
+        sflow_config_t sflow_config = {
+            .host = g_sflow_target,
+            .port = 0,
+        };
+        uint32_t port_count = 0;
+        if (colon != NULL) {
+            *colon = '\0';
+            sflow_config.port = (uint16_t)strtoul(colon + 1, NULL, 10);
+        }
+        err = sflow_init(&sflow_config);
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_CONTROL, "Ошибка запуска агента sFlow: %d", err);
+            return err;
+        }
+        if (port_get_count(&port_count) != STATUS_SUCCESS || port_count > CONFIG_MAX_PORTS) {
+            port_count = CONFIG_MAX_PORTS;
+        }
+        for (uint32_t port = 0; port < port_count; port++) {
+            (void)sflow_set_port_rate((port_id_t)port, g_sflow_rate);
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * CLI, его команды и сервер управления
+ */
+static status_t init_step_cli(void *arg) {
+    status_t err;
+    (void)arg;
+
     // Инициализируем глобальную cli_ctx
     memset((void*)&cli_ctx, 0, sizeof(cli_ctx));
 
@@ -198,6 +1134,270 @@ static status_t initialize_simulator(void) {
         LOG_ERROR(LOG_CATEGORY_CLI, "Ошибка инициализации CLI: %d", err);
         return err;
     }
+
+    // Без команды счётчики остаются доступны через packet_drop_get_counters()
+    if (cli_register_command((void*)&cli_ctx, &g_drops_command) != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Не удалось зарегистрировать команду drops");
+    }
+    if (cli_register_command((void*)&cli_ctx, &g_trace_command) != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Не удалось зарегистрировать команду trace");
+    }
+    // Без команды объёмы остаются доступны через mem_account_get()
+    if (cli_register_command((void*)&cli_ctx, &g_memory_command) != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Не удалось зарегистрировать команду memory");
+    }
+    // Без команды счётчики остаются доступны через event_bus_get_stats()
+    if (cli_register_command((void*)&cli_ctx, &g_event_bus_command) != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Не удалось зарегистрировать команду event-bus");
+    }
+    // Без команды счётчики остаются доступны через event_task_get_runtime_stats()
+    if (cli_register_command((void*)&cli_ctx, &g_tasks_command) != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Не удалось зарегистрировать команду tasks");
+    }
+
+#if CONFIG_ENABLE_PIPELINE_PROFILING
+    // Без команды профиль остаётся доступен через packet_profile_get()
+    if (cli_register_command((void*)&cli_ctx, &g_profile_command) != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Не удалось зарегистрировать команду pipeline-profile");
+    }
+#endif
+
+#if CONFIG_SPINLOCK_STATS
+    // Без команды счётчики остаются доступны через lock_stat_snapshot()
+    if (cli_register_command((void*)&cli_ctx, &g_locks_command) != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Не удалось зарегистрировать команду locks");
+    }
+#endif
+
+    // Сервер управления для внешних клиентов: REST поверх HTTP/1.1 в своём потоке
+    if (g_mgmt_listen != NULL) {
+        char *colon = strrchr(g_mgmt_listen, ':');
+        mgmt_server_config_t mgmt_config = {
+            .address = NULL,
+            .port = 0,
+            .cpu = -1,
+        };
+        if (colon != NULL) {
+            *colon = '\0';
+            mgmt_config.address = g_mgmt_listen;
+            mgmt_config.port = (uint16_t)strtoul(colon + 1, NULL, 10);
+        } else {
+            mgmt_config.port = (uint16_t)strtoul(g_mgmt_listen, NULL, 10);
+        }
+        err = mgmt_server_start(&mgmt_config);
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Ошибка запуска сервера управления: %d", err);
+            return err;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Конфигурация из файла нагрузки (комментарий заголовка pcapng) или из -c;
+ * STATUS_NOT_FOUND, если её нет ни там, ни там
+ */
+static status_t workload_load_config(void) {
+    size_t length = 0;
+    char probe;
+
+    if (g_workload.replay != NULL &&
+        pcap_replay_get_comment(g_workload.replay, &probe, 1, &length) == STATUS_SUCCESS) {
+        char *json = malloc(length + 1);
+        status_t err;
+
+        if (json == NULL) {
+            return STATUS_NO_MEMORY;
+        }
+        (void)pcap_replay_get_comment(g_workload.replay, json, length + 1, &length);
+        err = config_model_parse(&g_workload.config, json, length);
+        free(json);
+        if (g_config_path != NULL && err == STATUS_SUCCESS) {
+            LOG_WARNING(LOG_CATEGORY_SYSTEM, "Используется конфигурация из файла нагрузки, %s не читается",
+                        g_config_path);
+        }
+        return err;
+    }
+    if (g_config_path != NULL) {
+        bool cached = false;
+        return config_model_load_file(&g_workload.config, g_config_path, NULL, &cached);
+    }
+    return STATUS_NOT_FOUND;
+}
+
+/**
+ * Применённая конфигурация в JSON для заголовка записи; NULL, если её нет
+ */
+static char *workload_render_config(void) {
+    size_t size = 64 * 1024;
+
+    if (!g_workload.configured) {
+        return NULL;
+    }
+    for (;;) {
+        char *json = malloc(size);
+        size_t length;
+        status_t err;
+
+        if (json == NULL) {
+            return NULL;
+        }
+        err = config_model_render(&g_workload.config, json, size, &length);
+        if (err == STATUS_SUCCESS) {
+            return json;
+        }
+        free(json);
+        if (err != STATUS_RESOURCE_EXCEEDED) {
+            return NULL;
+        }
+        size *= 2;
+    }
+}
+
+/**
+ * Конфигурация при старте, запись и прогон нагрузки
+ *
+ * Прогон начинается последним шагом, когда пересылка уже работает: кадры
+ * файла идут в порты, на которых были записаны, а дайджест выхода стоит
+ * перед драйверами всех портов
+ */
+static status_t init_step_workload(void *arg) {
+    status_t err;
+    (void)arg;
+
+    config_model_init(&g_workload.config);
+
+    if (g_workload_replay_path != NULL) {
+        err = pcap_replay_open(g_workload_replay_path, &g_workload.replay);
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Ошибка открытия файла нагрузки %s: %d", g_workload_replay_path, err);
+            return err;
+        }
+    }
+
+    err = workload_load_config();
+    if (err == STATUS_SUCCESS) {
+        config_model_t running;
+        config_diff_stats_t stats;
+
+        // Первое применение: текущая конфигурация пуста, применяются все объекты
+        config_model_init(&running);
+        err = config_model_apply(&running, &g_workload.config, &stats);
+        config_model_free(&running);
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Ошибка применения конфигурации: %d, изменений с ошибкой: %u",
+                      err, stats.failed);
+            return err;
+        }
+        g_workload.configured = true;
+        LOG_INFO(LOG_CATEGORY_SYSTEM, "Конфигурация применена: %u портов, %u VLAN, %u маршрутов",
+                 stats.ports_enabled, stats.vlans_created, stats.routes_added);
+    } else if (err != STATUS_NOT_FOUND) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Ошибка чтения конфигурации: %d", err);
+        return err;
+    }
+
+    if (g_workload_record_path != NULL) {
+        char *json = workload_render_config();
+        err = workload_record_start(g_workload_record_path, json);
+        free(json);
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Ошибка начала записи нагрузки: %d", err);
+            return err;
+        }
+    }
+
+    if (g_workload.replay != NULL) {
+        pcap_replay_config_t replay_config = {
+            .port = PORT_ID_INVALID,
+            .timing = g_workload_timing,
+            .speed = g_workload_speed,
+            .burst = 0,
+            .loop = false,
+            .by_interface = true,
+        };
+
+        err = workload_digest_start();
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Ошибка установки дайджеста выхода: %d", err);
+            return err;
+        }
+
+        event_timer_init(&g_workload.timer, workload_timer_cb, NULL);
+        g_workload.start_ns = workload_now_ns();
+        err = pcap_replay_start(g_workload.replay, &replay_config);
+        if (err == STATUS_SUCCESS) {
+            err = event_timer_start(&g_workload.timer, WORKLOAD_POLL_INTERVAL_US, WORKLOAD_POLL_INTERVAL_US);
+        }
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Ошибка запуска прогона нагрузки: %d", err);
+            return err;
+        }
+        LOG_INFO(LOG_CATEGORY_SYSTEM, "Прогон нагрузки %s", g_workload_replay_path);
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * Остановка прогона и записи нагрузки, пока порты ещё существуют
+ */
+static void workload_shutdown(void) {
+    if (g_workload.replay != NULL) {
+        pcap_replay_stop(g_workload.replay);
+        workload_digest_stop();
+        pcap_replay_close(g_workload.replay);
+        g_workload.replay = NULL;
+    }
+    if (g_workload_record_path != NULL) {
+        (void)workload_record_stop(NULL);
+    }
+    config_model_free(&g_workload.config);
+}
+
+/**
+ * Инициализация всех компонентов симулятора
+ *
+ * Независимые модули (таблицы MAC и VLAN, контроль штормов, маршрутизация с
+ * загрузкой маршрутов) инициализируются параллельно; время каждого шага
+ * пишется в журнал
+ */
+static status_t initialize_simulator(void) {
+    static const init_step_t steps[INIT_STEP_COUNT] = {
+        [INIT_STEP_BSP] = { "bsp", init_step_bsp, NULL, 0 },
+        [INIT_STEP_HAL] = { "hal", init_step_hal, NULL, INIT_AFTER(INIT_STEP_BSP) },
+        [INIT_STEP_MAC] = { "mac_table", init_step_mac, NULL, INIT_AFTER(INIT_STEP_HAL) },
+        [INIT_STEP_VLAN] = { "vlan", init_step_vlan, NULL, INIT_AFTER(INIT_STEP_HAL) },
+        [INIT_STEP_LAG] = { "lag", init_step_lag, NULL, INIT_AFTER(INIT_STEP_HAL) },
+        [INIT_STEP_MCAST] = { "mcast_snoop", init_step_mcast, NULL, INIT_AFTER(INIT_STEP_HAL) },
+        [INIT_STEP_STORM] = { "storm_control", init_step_storm, NULL, INIT_AFTER(INIT_STEP_HAL) },
+        [INIT_STEP_MIRROR] = { "mirror", init_step_mirror, NULL, INIT_AFTER(INIT_STEP_HAL) },
+        [INIT_STEP_MPLS] = { "mpls", init_step_mpls, NULL, INIT_AFTER(INIT_STEP_HAL) },
+        [INIT_STEP_CONNTRACK] = { "conntrack", init_step_conntrack, NULL, INIT_AFTER(INIT_STEP_HAL) },
+        [INIT_STEP_POLICER] = { "policer", init_step_policer, NULL, INIT_AFTER(INIT_STEP_HAL) },
+        [INIT_STEP_ROUTING] = { "routing", init_step_routing, NULL, INIT_AFTER(INIT_STEP_HAL) },
+        // Контрольная точка восстанавливает записи MAC и маршруты поверх загруженных
+        [INIT_STEP_WARM_RESTART] = { "warm_restart", init_step_warm_restart, NULL,
+                                     INIT_AFTER(INIT_STEP_MAC) | INIT_AFTER(INIT_STEP_VLAN) |
+                                     INIT_AFTER(INIT_STEP_ROUTING) },
+        [INIT_STEP_SAI] = { "sai", init_step_sai, NULL,
+                            INIT_AFTER(INIT_STEP_STORM) | INIT_AFTER(INIT_STEP_MIRROR) |
+                            INIT_AFTER(INIT_STEP_MPLS) | INIT_AFTER(INIT_STEP_CONNTRACK) |
+                            INIT_AFTER(INIT_STEP_POLICER) | INIT_AFTER(INIT_STEP_WARM_RESTART) },
+        [INIT_STEP_FORWARDING] = { "forwarding", init_step_forwarding, NULL, INIT_AFTER(INIT_STEP_SAI) },
+        [INIT_STEP_EVENTS] = { "event_loop", init_step_events, NULL,
+                               INIT_AFTER(INIT_STEP_WARM_RESTART) | INIT_AFTER(INIT_STEP_LAG) |
+                               INIT_AFTER(INIT_STEP_MCAST) | INIT_AFTER(INIT_STEP_FORWARDING) },
+        [INIT_STEP_STATS] = { "stats", init_step_stats, NULL, INIT_AFTER(INIT_STEP_FORWARDING) },
+        [INIT_STEP_CLI] = { "cli", init_step_cli, NULL, INIT_AFTER(INIT_STEP_STATS) },
+        [INIT_STEP_WORKLOAD] = { "workload", init_step_workload, NULL,
+                                 INIT_AFTER(INIT_STEP_FORWARDING) | INIT_AFTER(INIT_STEP_EVENTS) },
+    };
+    status_t err;
+
+    err = init_graph_run(steps, INIT_STEP_COUNT, CONFIG_INIT_THREADS, NULL);
+    if (err != STATUS_SUCCESS) {
+        return err;
+    }
     
     LOG_INFO(LOG_CATEGORY_SYSTEM, "Инициализация завершена успешно");
     return STATUS_SUCCESS;
@@ -210,12 +1410,48 @@ static void deinitialize_simulator(void) {
     LOG_INFO(LOG_CATEGORY_SYSTEM, "Деинициализация системы...");
     
     // Деинициализация в обратном порядке
+    workload_shutdown();
+    if (g_mgmt_listen != NULL) {
+        (void)mgmt_server_stop();
+    }
     cli_cleanup((void*)&cli_ctx);           //    cli_deinit();
+    if (g_sflow_target != NULL) {
+        // Выборки, ещё стоящие в очереди, отправляются перед остановкой
+        (void)sflow_shutdown();
+    }
     stats_cleanup((void*)&stats_ctx);       //    stats_deinit();
+    if (g_warm_restart_path != NULL) {
+        // Контрольная точка для горячего перезапуска, пока таблицы ещё заполнены
+        (void)warm_restart_checkpoint(NULL);
+        warm_restart_deinit();
+    }
+    (void)bfd_shutdown();
+    (void)event_task_shutdown();
+    // Оставшиеся на шине события доставляются подписчикам
+    (void)event_bus_shutdown();
+    event_loop_shutdown();
+    forwarding_shutdown();
+    if (g_cpu_trap_name != NULL) {
+        (void)punt_shutdown();
+    }
     sai_adapter_deinit();
+    if (g_route_dump_path != NULL) {
+        // Образ таблицы для быстрой загрузки при следующем старте (-r)
+        (void)route_loader_dump(g_route_dump_path, NULL);
+    }
     routing_table_cleanup();                // routing_table_deinit();
+    mfib_deinit();
+    storm_control_cleanup();
+    mpls_cleanup();
+    conntrack_cleanup();
+    policer_cleanup();
+    mirror_cleanup();
+    mcast_snoop_deinit();
+    lag_deinit();
     vlan_deinit();
     mac_table_deinit();
+    // Поток punt уже остановлен, писать в кольцо некому
+    cpu_trap_close();
     hw_resources_shutdown();                //    hw_resources_deinit();
     bsp_deinit();
     
@@ -228,12 +1464,9 @@ static void deinitialize_simulator(void) {
 static void simulator_main_loop(void) {
     LOG_INFO(LOG_CATEGORY_CONTROL, "Запуск основного цикла симулятора");
     
-    while (g_running) {
-        // Обработка пакетов и других задач
-        // ...
-        
-        // Чтобы не загружать процессор на 100%
-        usleep(1000);
+    // Процесс спит в epoll до ближайшего таймера или события
+    if (g_running) {
+        event_loop_run();
     }
     
     LOG_INFO(LOG_CATEGORY_CONTROL, "Основной цикл симулятора завершен");
@@ -251,12 +1484,108 @@ int main(int argc, char *argv[]) {
     //    в конечной версии нужно будет его открыть вместо log_init(NULL);      
     // Инициализация системы логирования (вывод в консоль)
     log_init(NULL);
+    // Точка отсчёта для перевода тактов трассировки во время
+    trace_init();
 
     LOG_INFO(LOG_CATEGORY_SYSTEM, "Switch Simulator запущен");
     
     // Проверка и обработка аргументов командной строки
-    // Здесь можно добавить парсинг аргументов
+    int opt;
+    while ((opt = getopt(argc, argv, "r:d:w:W:s:H:I:t:T:f:F:v:c:R:p:P:k:C:m:")) != -1) {
+        switch (opt) {
+            case 'r':
+                g_route_load_path = optarg;
+                break;
+            case 'd':
+                g_route_dump_path = optarg;
+                break;
+            case 'w':
+                g_warm_restart_path = optarg;
+                break;
+            case 'W':
+                g_warm_restart_interval_s = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                g_stats_shm_name = optarg;
+                break;
+            case 'H':
+                g_history_shm_name = optarg;
+                break;
+            case 'I':
+                g_history_interval_ms = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case 't':
+                g_telemetry_target = optarg;
+                break;
+            case 'T':
+                g_telemetry_interval_ms = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'f':
+                g_sflow_target = optarg;
+                break;
+            case 'F':
+                g_sflow_rate = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'v':
+                g_virtual_run_s = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                g_config_path = optarg;
+                break;
+            case 'C':
+                g_cpu_trap_name = optarg;
+                break;
+            case 'm':
+                g_mgmt_listen = optarg;
+                break;
+            case 'R':
+                g_workload_record_path = optarg;
+                break;
+            case 'p':
+                g_workload_replay_path = optarg;
+                break;
+            case 'P':
+                if (strcmp(optarg, "max") == 0) {
+                    g_workload_timing = PCAP_REPLAY_MAX_RATE;
+                } else if (strcmp(optarg, "real") == 0) {
+                    g_workload_timing = PCAP_REPLAY_ORIGINAL;
+                } else {
+                    g_workload_timing = PCAP_REPLAY_SCALED;
+                    g_workload_speed = strtod(optarg, NULL);
+                }
+                break;
+            case 'k':
+                g_workload_check = true;
+                g_workload_expected = strtoull(optarg, NULL, 16);
+                break;
+            default:
+                fprintf(stderr, "Использование: %s [-r файл_маршрутов] [-d файл_образа] "
+                        "[-w контрольная_точка [-W период_с]] [-s сегмент_статистики] [-H сегмент_истории [-I период_мс]] "
+                        "[-t хост:порт [-T период_мс]] [-f хост:порт [-F 1_из_N]] [-v секунды] "
+                        "[-c конфигурация.json] [-C сегмент_перехвата] [-R запись_нагрузки] [-m [адрес:]порт] "
+                        "[-p нагрузка [-P max|real|скорость] [-k дайджест]]\n", argv[0]);
+                log_shutdown();
+                return EXIT_FAILURE;
+        }
+    }
+    
+    if (g_history_interval_ms == 0) {
+        fprintf(stderr, "Период истории счётчиков (-I) должен быть положительным\n");
+        log_shutdown();
+        return EXIT_FAILURE;
+    }
     
+    if (g_workload_timing == PCAP_REPLAY_SCALED && !(g_workload_speed > 0)) {
+        fprintf(stderr, "Скорость прогона (-P) должна быть max, real или положительным числом\n");
+        log_shutdown();
+        return EXIT_FAILURE;
+    }
+
+    // Виртуальные часы: таймеры идут без ожидания, прогон завершается через -v секунд
+    if (g_virtual_run_s > 0) {
+        sim_clock_set_mode(SIM_CLOCK_VIRTUAL);
+    }
+
     // Настройка обработчиков сигналов
     err = setup_signal_handlers();
     if (err != STATUS_SUCCESS) {
@@ -285,5 +1614,5 @@ int main(int argc, char *argv[]) {
     //log_deinit();
     log_shutdown();
     
-    return EXIT_SUCCESS;
+    return g_workload.exit_status;
 }
@@ -0,0 +1,462 @@
+/**
+ * @file bulk_api.c
+ * @brief Column-array entry points for bulk table reads and writes
+ *
+ * The calls translate between caller columns and the rows the table
+ * modules take, then make one bulk call per batch: routes go through one
+ * routing table batch, memberships through the VLAN bulk calls, and reads
+ * through one walk or snapshot.
+ */
+
+#include "management/bulk_api.h"
+#include "common/bitmap.h"
+#include "common/logging.h"
+#include "hal/port.h"
+#include "l2/mac_table.h"
+#include "l2/vlan.h"
+#include "l3/routing_table.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Rows taken from a table per page call of the paged reads */
+#define BULK_PAGE_ROWS 256
+
+/* Walk of the routing table into columns */
+typedef struct {
+    const bulk_route_columns_t *routes;
+    uint32_t capacity;
+    uint32_t count;
+} bulk_route_walk_t;
+
+static void bulk_set_statuses(status_t *statuses, uint32_t count, status_t status) {
+    if (statuses) {
+        for (uint32_t i = 0; i < count; i++) {
+            statuses[i] = status;
+        }
+    }
+}
+
+/* Address bytes of either family, in network order */
+static inline uint8_t *bulk_addr_bytes(ip_addr_t *addr) {
+    return addr->type == IP_TYPE_V4 ? (uint8_t *)&addr->addr.v4 : addr->addr.v6.addr;
+}
+
+static inline size_t bulk_addr_len(ip_addr_type_t type) {
+    return type == IP_TYPE_V4 ? 4 : 16;
+}
+
+/* --- Routes --------------------------------------------------------------- */
+
+static status_t bulk_route_from_row(const bulk_route_columns_t *routes, uint32_t row, routing_route_t *route) {
+    memset(route, 0, sizeof(*route));
+    route->type = (routes->is_ipv6 && routes->is_ipv6[row]) ? IP_TYPE_V6 : IP_TYPE_V4;
+    route->prefix.type = route->type;
+    route->next_hop.type = route->type;
+    route->prefix_len = routes->prefix_len[row];
+    if (route->prefix_len > bulk_addr_len(route->type) * 8) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memcpy(bulk_addr_bytes(&route->prefix), routes->prefix[row], bulk_addr_len(route->type));
+    if (routes->next_hop) {
+        memcpy(bulk_addr_bytes(&route->next_hop), routes->next_hop[row], bulk_addr_len(route->type));
+    }
+    route->interface_index = routes->interface ? routes->interface[row] : 0;
+    route->metric = routes->metric ? routes->metric[row] : 0;
+    route->source = routes->source ? (route_source_t)routes->source[row] : ROUTE_TYPE_STATIC;
+    return STATUS_SUCCESS;
+}
+
+status_t bulk_update_routes(const bulk_route_columns_t *routes, uint32_t count, bool remove,
+                            status_t *statuses) {
+    routing_route_t *rows;
+    uint32_t *row_of;
+    uint32_t valid = 0;
+    status_t result = STATUS_SUCCESS;
+    status_t status;
+
+    if (!routes || (count > 0 && (!routes->prefix || !routes->prefix_len))) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (count == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    rows = (routing_route_t *)malloc(count * sizeof(routing_route_t));
+    row_of = (uint32_t *)malloc(count * sizeof(uint32_t));
+    status_t *row_statuses = (status_t *)malloc(count * sizeof(status_t));
+    if (!rows || !row_of || !row_statuses) {
+        free(rows);
+        free(row_of);
+        free(row_statuses);
+        bulk_set_statuses(statuses, count, STATUS_NO_MEMORY);
+        return STATUS_NO_MEMORY;
+    }
+
+    // Bad rows are reported and left out; the rest go to the table in one call
+    for (uint32_t i = 0; i < count; i++) {
+        status = bulk_route_from_row(routes, i, &rows[valid]);
+        if (statuses) {
+            statuses[i] = status;
+        }
+        if (status == STATUS_SUCCESS) {
+            row_of[valid++] = i;
+        } else {
+            result = status;
+        }
+    }
+
+    if (valid > 0) {
+        bool batched = routing_table_begin_batch() == STATUS_SUCCESS;
+        status = routing_table_update_routes(rows, valid, remove, false, row_statuses);
+        if (batched && routing_table_commit_batch() != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Bulk API: routing table batch commit failed");
+        }
+        if (status != STATUS_SUCCESS) {
+            result = status;
+        }
+        for (uint32_t i = 0; i < valid && statuses; i++) {
+            statuses[row_of[i]] = row_statuses[i];
+        }
+    }
+
+    free(rows);
+    free(row_of);
+    free(row_statuses);
+    return result;
+}
+
+static void bulk_route_to_row(const bulk_route_columns_t *routes, uint32_t row, const routing_route_t *route) {
+    ip_addr_t addr;
+
+    if (routes->prefix) {
+        addr = route->prefix;
+        addr.type = route->type;
+        memset(routes->prefix[row], 0, BULK_ADDR_LEN);
+        memcpy(routes->prefix[row], bulk_addr_bytes(&addr), bulk_addr_len(route->type));
+    }
+    if (routes->next_hop) {
+        addr = route->next_hop;
+        addr.type = route->type;
+        memset(routes->next_hop[row], 0, BULK_ADDR_LEN);
+        memcpy(routes->next_hop[row], bulk_addr_bytes(&addr), bulk_addr_len(route->type));
+    }
+    if (routes->is_ipv6) {
+        routes->is_ipv6[row] = route->type == IP_TYPE_V6;
+    }
+    if (routes->prefix_len) {
+        routes->prefix_len[row] = route->prefix_len;
+    }
+    if (routes->interface) {
+        routes->interface[row] = route->interface_index;
+    }
+    if (routes->metric) {
+        routes->metric[row] = route->metric;
+    }
+    if (routes->source) {
+        routes->source[row] = (uint8_t)route->source;
+    }
+}
+
+static void bulk_route_walk_cb(const routing_route_t *route, void *ctx) {
+    bulk_route_walk_t *walk = (bulk_route_walk_t *)ctx;
+    uint32_t row = walk->count++;
+
+    if (row < walk->capacity) {
+        bulk_route_to_row(walk->routes, row, route);
+    }
+}
+
+status_t bulk_read_routes(const bulk_route_columns_t *routes, uint32_t capacity, uint32_t *count) {
+    bulk_route_walk_t walk = { .routes = routes, .capacity = capacity, .count = 0 };
+
+    if (!routes || !count) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    status_t status = routing_table_walk(bulk_route_walk_cb, &walk);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    *count = walk.count;
+    return walk.count > capacity ? STATUS_OUT_OF_BOUNDS : STATUS_SUCCESS;
+}
+
+status_t bulk_read_routes_page(const bulk_route_columns_t *routes, uint32_t capacity, table_cursor_t *cursor,
+                               uint32_t *count) {
+    routing_route_t rows[BULK_PAGE_ROWS];
+    uint32_t n = 0;
+
+    if (!routes || !cursor || !count) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // One table page per chunk, so the routing lock is held for a chunk at a time
+    while (n < capacity && *cursor != TABLE_CURSOR_END) {
+        uint32_t got;
+        uint32_t want = capacity - n < BULK_PAGE_ROWS ? capacity - n : BULK_PAGE_ROWS;
+        status_t status = routing_table_get_routes_page(cursor, rows, want, &got);
+        if (status != STATUS_SUCCESS) {
+            *count = n;
+            return status;
+        }
+        for (uint32_t i = 0; i < got; i++) {
+            bulk_route_to_row(routes, n++, &rows[i]);
+        }
+    }
+
+    *count = n;
+    return STATUS_SUCCESS;
+}
+
+/* --- MAC table ------------------------------------------------------------ */
+
+status_t bulk_update_mac_entries(const bulk_mac_columns_t *entries, uint32_t count, bool remove,
+                                 status_t *statuses) {
+    status_t result = STATUS_SUCCESS;
+
+    if (!entries || (count > 0 && (!entries->mac || !entries->vlan_id || (!remove && !entries->port_id)))) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // The MAC table takes one entry per call; the rows still cross the FFI once
+    for (uint32_t i = 0; i < count; i++) {
+        mac_addr_t mac;
+        status_t status;
+
+        memcpy(mac.addr, entries->mac[i], MAC_ADDR_LEN);
+        if (remove) {
+            status = mac_table_remove(mac, entries->vlan_id[i]);
+        } else {
+            status = mac_table_add(mac, entries->port_id[i], entries->vlan_id[i], true);
+        }
+        if (statuses) {
+            statuses[i] = status;
+        }
+        if (status != STATUS_SUCCESS) {
+            result = status;
+        }
+    }
+    return result;
+}
+
+static void bulk_mac_to_row(const bulk_mac_columns_t *entries, uint32_t row, const mac_table_entry_t *entry) {
+    if (entries->mac) {
+        memcpy(entries->mac[row], entry->mac_addr.addr, MAC_ADDR_LEN);
+    }
+    if (entries->vlan_id) {
+        entries->vlan_id[row] = entry->vlan_id;
+    }
+    if (entries->port_id) {
+        entries->port_id[row] = entry->port_id;
+    }
+    if (entries->type) {
+        entries->type[row] = (uint8_t)entry->type;
+    }
+    if (entries->age_timestamp) {
+        entries->age_timestamp[row] = entry->age_timestamp;
+    }
+}
+
+status_t bulk_read_mac_entries(const bulk_mac_columns_t *entries, uint32_t capacity, uint32_t *count) {
+    mac_table_snapshot_t snapshot;
+
+    if (!entries || !count) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    status_t status = mac_table_snapshot_create(&snapshot);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    *count = snapshot.count;
+    if (snapshot.count > capacity) {
+        mac_table_snapshot_free(&snapshot);
+        return STATUS_OUT_OF_BOUNDS;
+    }
+
+    for (uint32_t i = 0; i < snapshot.count; i++) {
+        bulk_mac_to_row(entries, i, &snapshot.entries[i]);
+    }
+
+    mac_table_snapshot_free(&snapshot);
+    return STATUS_SUCCESS;
+}
+
+status_t bulk_read_mac_entries_page(const bulk_mac_columns_t *entries, uint32_t capacity, table_cursor_t *cursor,
+                                    uint32_t *count) {
+    mac_table_entry_t rows[BULK_PAGE_ROWS];
+    uint32_t n = 0;
+
+    if (!entries || !cursor || !count) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    while (n < capacity && *cursor != TABLE_CURSOR_END) {
+        uint32_t got;
+        uint32_t want = capacity - n < BULK_PAGE_ROWS ? capacity - n : BULK_PAGE_ROWS;
+        status_t status = mac_table_get_entries_page(cursor, rows, want, &got);
+        if (status != STATUS_SUCCESS) {
+            *count = n;
+            return status;
+        }
+        for (uint32_t i = 0; i < got; i++) {
+            bulk_mac_to_row(entries, n++, &rows[i]);
+        }
+    }
+
+    *count = n;
+    return STATUS_SUCCESS;
+}
+
+/* --- VLAN memberships ----------------------------------------------------- */
+
+status_t bulk_update_vlan_members(const bulk_vlan_member_columns_t *members, uint32_t count,
+                                  bool remove, status_t *statuses) {
+    vlan_member_t *rows;
+    status_t status;
+
+    if (!members || (count > 0 && (!members->vlan_id || !members->port_id))) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (count == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    rows = (vlan_member_t *)malloc(count * sizeof(vlan_member_t));
+    if (!rows) {
+        bulk_set_statuses(statuses, count, STATUS_NO_MEMORY);
+        return STATUS_NO_MEMORY;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        rows[i].vlan_id = members->vlan_id[i];
+        rows[i].port_id = members->port_id[i];
+        rows[i].member_type = (members->tagged && members->tagged[i]) ? VLAN_MEMBER_TAGGED : VLAN_MEMBER_UNTAGGED;
+    }
+
+    if (remove) {
+        status = vlan_remove_members_bulk(rows, count, false, statuses);
+    } else {
+        status = vlan_add_members_bulk(rows, count, false, statuses);
+    }
+
+    free(rows);
+    return status;
+}
+
+status_t bulk_read_vlan_members(const bulk_vlan_member_columns_t *members, uint32_t capacity,
+                                uint32_t *count) {
+    uint64_t active[VLAN_ID_WORDS];
+    uint32_t rows = 0;
+
+    if (!members || !count) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    status_t status = vlan_get_active_bitmap(active);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+
+    BITMAP_FOR_EACH(vlan_id, active, VLAN_ID_WORDS) {
+        vlan_port_bitmap_t ports;
+        vlan_port_bitmap_t untagged;
+
+        // Deleted since the bitmap was read
+        if (vlan_get_member_bitmaps((vlan_id_t)vlan_id, &ports, &untagged) != STATUS_SUCCESS) {
+            continue;
+        }
+
+        BITMAP_FOR_EACH(port_id, ports.w, VLAN_PORT_WORDS) {
+            uint32_t row = rows++;
+
+            if (row >= capacity) {
+                continue;
+            }
+            if (members->vlan_id) {
+                members->vlan_id[row] = (vlan_id_t)vlan_id;
+            }
+            if (members->port_id) {
+                members->port_id[row] = (uint16_t)port_id;
+            }
+            if (members->tagged) {
+                members->tagged[row] = !bitmap_test(untagged.w, port_id);
+            }
+        }
+    }
+
+    *count = rows;
+    return rows > capacity ? STATUS_OUT_OF_BOUNDS : STATUS_SUCCESS;
+}
+
+/* --- Counters ------------------------------------------------------------- */
+
+status_t bulk_read_port_counters(const uint16_t *port_ids, uint32_t count, uint64_t *counters,
+                                 status_t *statuses) {
+    status_t result = STATUS_SUCCESS;
+
+    if (count > 0 && (!port_ids || !counters)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        port_stats_t stats;
+        status_t status = port_get_stats(port_ids[i], &stats);
+
+        if (status != STATUS_SUCCESS) {
+            memset(&stats, 0, sizeof(stats));
+            result = status;
+        }
+        if (statuses) {
+            statuses[i] = status;
+        }
+
+        counters[BULK_PORT_RX_PACKETS * count + i] = stats.rx_packets;
+        counters[BULK_PORT_TX_PACKETS * count + i] = stats.tx_packets;
+        counters[BULK_PORT_RX_BYTES * count + i] = stats.rx_bytes;
+        counters[BULK_PORT_TX_BYTES * count + i] = stats.tx_bytes;
+        counters[BULK_PORT_RX_ERRORS * count + i] = stats.rx_errors;
+        counters[BULK_PORT_TX_ERRORS * count + i] = stats.tx_errors;
+        counters[BULK_PORT_RX_DROPS * count + i] = stats.rx_drops;
+        counters[BULK_PORT_TX_DROPS * count + i] = stats.tx_drops;
+        counters[BULK_PORT_RX_UNICAST * count + i] = stats.rx_unicast;
+        counters[BULK_PORT_TX_UNICAST * count + i] = stats.tx_unicast;
+        counters[BULK_PORT_RX_BROADCAST * count + i] = stats.rx_broadcast;
+        counters[BULK_PORT_TX_BROADCAST * count + i] = stats.tx_broadcast;
+        counters[BULK_PORT_RX_MULTICAST * count + i] = stats.rx_multicast;
+        counters[BULK_PORT_TX_MULTICAST * count + i] = stats.tx_multicast;
+        counters[BULK_PORT_COLLISIONS * count + i] = stats.collisions;
+    }
+    return result;
+}
+
+status_t bulk_read_vlan_counters(const uint16_t *vlan_ids, uint32_t count, uint64_t *counters,
+                                 status_t *statuses) {
+    status_t result = STATUS_SUCCESS;
+
+    if (count > 0 && (!vlan_ids || !counters)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        vlan_counters_t stats;
+        status_t status = vlan_get_counters(vlan_ids[i], &stats);
+
+        if (status != STATUS_SUCCESS) {
+            memset(&stats, 0, sizeof(stats));
+            result = status;
+        }
+        if (statuses) {
+            statuses[i] = status;
+        }
+
+        counters[BULK_VLAN_RX_PACKETS * count + i] = stats.rx_packets;
+        counters[BULK_VLAN_RX_BYTES * count + i] = stats.rx_bytes;
+        counters[BULK_VLAN_TX_PACKETS * count + i] = stats.tx_packets;
+        counters[BULK_VLAN_TX_BYTES * count + i] = stats.tx_bytes;
+    }
+    return result;
+}
@@ -1,11 +1,21 @@
 /**
  * @file cli_engine.c
  * @brief Реализация движка командной строки для switch-simulator
+ *
+ * Команды хранятся в префиксном дереве по символам имени: поиск команды
+ * стоит длину имени, а не число команд, и любое однозначное сокращение
+ * имени в текущем режиме находит команду.
+ *
+ * Пакетный режим (cli_run_script) выполняет файл команд построчно.
+ * Идущие подряд команды режимов конфигурации объединяются в одну
+ * транзакцию таблицы маршрутизации, а вывод копится в буфере и отдаётся
+ * обработчику вывода крупными кусками.
  */
 
 #include "include/management/cli.h"
 #include "include/common/logging.h"
 #include "include/common/error_codes.h"
+#include "include/l3/routing_table.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,6 +33,17 @@
 /* Максимальная глубина для режимов CLI */
 #define MAX_CLI_MODE_DEPTH 8
 
+/* Объём вывода пакетного режима, после которого он отдаётся обработчику */
+#define CLI_BATCH_OUTPUT_FLUSH (64 * 1024)
+
+/* Узел префиксного дерева команд */
+typedef struct cli_trie_node {
+    char ch;                        /* Символ имени на этом уровне */
+    int command;                    /* Индекс команды, имя которой здесь кончается, или -1 */
+    struct cli_trie_node *child;    /* Первый узел следующего уровня */
+    struct cli_trie_node *sibling;  /* Следующий узел этого уровня, по возрастанию символа */
+} cli_trie_node_t;
+
 /* Структура для хранения информации о команде */
 typedef struct {
     char *command;                  /* Имя команды */
@@ -44,6 +65,11 @@ typedef struct {
     void *output_context;                      /* Контекст для обработчика вывода */
     cli_input_handler_t input_handler;         /* Обработчик ввода */
     void *input_context;                       /* Контекст для обработчика ввода */
+    bool batch;                                /* Выполняется сценарий */
+    bool in_transaction;                       /* Открыта транзакция конфигурации */
+    char *batch_output;                        /* Накопленный вывод сценария */
+    size_t batch_output_len;
+    size_t batch_output_size;
 } cli_state_t;
 
 /* Глобальные переменные */
@@ -51,12 +77,14 @@ static cli_command_entry_t commands[MAX_CLI_COMMANDS];
 static int command_count = 0;
 static cli_state_t cli_state;
 static bool cli_initialized = false;
+static cli_trie_node_t *command_trie = NULL;    /* Корень: узлы первого символа имён */
 
 /* Предварительные объявления функций */
 static void cli_update_prompt(void);
-static void cli_process_command(const char *input);
+static cli_status_t cli_process_command(const char *input);
 static void cli_handle_help(const char *command);
 static int cli_tokenize(char *input, char *tokens[], int max_tokens);
+static void cli_batch_flush(void);
 
 /* Стандартные обработчики вывода и ввода */
 static void default_output_handler(const char *output, void *context) {
@@ -79,6 +107,113 @@ static char *default_input_handler(void *context) {
     return input;
 }
 
+/**
+ * @brief Узел дерева, в котором кончается префикс
+ * 
+ * @param prefix Префикс имени команды
+ * @return cli_trie_node_t* Узел или NULL, если ни одно имя так не начинается
+ */
+static cli_trie_node_t *cli_trie_walk(const char *prefix) {
+    cli_trie_node_t *level = command_trie;
+    cli_trie_node_t *node = NULL;
+    
+    for (const char *c = prefix; *c != '\0'; c++) {
+        node = level;
+        while (node != NULL && node->ch < *c) {
+            node = node->sibling;
+        }
+        if (node == NULL || node->ch != *c) {
+            return NULL;
+        }
+        level = node->child;
+    }
+    
+    return node;
+}
+
+/**
+ * @brief Добавление имени команды в дерево
+ * 
+ * @param command Имя команды
+ * @param index Индекс команды в таблице
+ * @return bool false при нехватке памяти
+ */
+static bool cli_trie_insert(const char *command, int index) {
+    cli_trie_node_t **level = &command_trie;
+    cli_trie_node_t *node = NULL;
+    
+    for (const char *c = command; *c != '\0'; c++) {
+        cli_trie_node_t **link = level;
+        while (*link != NULL && (*link)->ch < *c) {
+            link = &(*link)->sibling;
+        }
+        if (*link == NULL || (*link)->ch != *c) {
+            cli_trie_node_t *added = (cli_trie_node_t *)calloc(1, sizeof(cli_trie_node_t));
+            if (added == NULL) {
+                return false;
+            }
+            added->ch = *c;
+            added->command = -1;
+            added->sibling = *link;
+            *link = added;
+        }
+        node = *link;
+        level = &node->child;
+    }
+    
+    node->command = index;
+    return true;
+}
+
+/**
+ * @brief Освобождение поддерева
+ * 
+ * @param node Первый узел уровня
+ */
+static void cli_trie_free(cli_trie_node_t *node) {
+    while (node != NULL) {
+        cli_trie_node_t *next = node->sibling;
+        cli_trie_free(node->child);
+        free(node);
+        node = next;
+    }
+}
+
+/**
+ * @brief Доступна ли команда в режиме
+ */
+static bool cli_command_visible(int index, cli_mode_t mode) {
+    return commands[index].is_active &&
+           (commands[index].mode == mode || commands[index].mode == CLI_MODE_ANY);
+}
+
+/**
+ * @brief Поиск команд поддерева, доступных в режиме
+ * 
+ * @param node Узел, с которого начинается поддерево
+ * @param mode Режим CLI
+ * @param found Индекс первой найденной команды
+ * @return int Число найденных команд, не больше двух: больше не нужно
+ */
+static int cli_trie_collect(const cli_trie_node_t *node, cli_mode_t mode, int *found) {
+    int count = 0;
+    
+    if (node->command >= 0 && cli_command_visible(node->command, mode)) {
+        *found = node->command;
+        count++;
+    }
+    for (const cli_trie_node_t *child = node->child; child != NULL && count < 2; child = child->sibling) {
+        int index;
+        int n = cli_trie_collect(child, mode, &index);
+        if (n > 0 && count == 0) {
+            *found = index;
+        }
+        count += n;
+    }
+    
+    return count;
+}
+
 /**
  * @brief Инициализация движка CLI
  * 
@@ -116,14 +251,14 @@ cli_status_t cli_initialize(cli_output_handler_t output_handler, void *output_co
     /* Обновление промпта */
     cli_update_prompt();
     
-    /* Регистрация базовых команд */
+    /* Регистрация базовых команд; cli_register_command требует готового движка */
+    cli_initialized = true;
     cli_register_command("help", "Show available commands", "Displays a list of available commands. Use 'help <command>' for detailed help on a specific command.", 
                          CLI_MODE_ANY, cli_handle_help, NULL);
     
     cli_register_command("exit", "Exit current mode or CLI", "Exits the current CLI mode. In normal mode, exits the CLI.", 
                          CLI_MODE_ANY, NULL, NULL);
     
-    cli_initialized = true;
     LOG_INFO("CLI engine initialized successfully");
     
     return CLI_STATUS_SUCCESS;
@@ -179,11 +314,10 @@ cli_status_t cli_register_command(const char *command, const char *help, const c
     }
     
     /* Проверка наличия команды */
-    for (int i = 0; i < command_count; i++) {
-        if (commands[i].is_active && strcmp(commands[i].command, command) == 0) {
-            LOG_ERROR("Command '%s' already registered", command);
-            return CLI_STATUS_DUPLICATE;
-        }
+    cli_trie_node_t *existing = cli_trie_walk(command);
+    if (existing != NULL && existing->command >= 0 && commands[existing->command].is_active) {
+        LOG_ERROR("Command '%s' already registered", command);
+        return CLI_STATUS_DUPLICATE;
     }
     
     /* Проверка переполнения таблицы команд */
@@ -203,6 +337,15 @@ cli_status_t cli_register_command(const char *command, const char *help, const c
     commands[index].comp = comp;
     commands[index].is_active = true;
     
+    if (!cli_trie_insert(command, index)) {
+        LOG_ERROR("Failed to allocate memory for command '%s'", command);
+        free(commands[index].command);
+        free(commands[index].help);
+        free(commands[index].description);
+        commands[index].is_active = false;
+        return CLI_STATUS_OVERFLOW;
+    }
+    
     LOG_INFO("Registered command '%s' in mode %d", command, mode);
     
     return CLI_STATUS_SUCCESS;
@@ -226,19 +369,21 @@ cli_status_t cli_unregister_command(const char *command) {
     }
     
     /* Поиск команды */
-    for (int i = 0; i < command_count; i++) {
-        if (commands[i].is_active && strcmp(commands[i].command, command) == 0) {
-            /* Освобождение памяти */
-            free(commands[i].command);
-            free(commands[i].help);
-            free(commands[i].description);
-            
-            /* Пометка команды как неактивной */
-            commands[i].is_active = false;
-            
-            LOG_INFO("Unregistered command '%s'", command);
-            return CLI_STATUS_SUCCESS;
-        }
+    cli_trie_node_t *node = cli_trie_walk(command);
+    if (node != NULL && node->command >= 0 && commands[node->command].is_active) {
+        int i = node->command;
+        
+        /* Освобождение памяти */
+        free(commands[i].command);
+        free(commands[i].help);
+        free(commands[i].description);
+        
+        /* Пометка команды как неактивной; узлы дерева остаются до деинициализации */
+        commands[i].is_active = false;
+        node->command = -1;
+        
+        LOG_INFO("Unregistered command '%s'", command);
+        return CLI_STATUS_SUCCESS;
     }
     
     LOG_WARN("Command '%s' not found", command);
@@ -246,21 +391,32 @@ cli_status_t cli_unregister_command(const char *command) {
 }
 
 /**
- * @brief Поиск команды по имени
+ * @brief Поиск команды по имени или его сокращению
  * 
- * @param command Имя команды
+ * Точное совпадение имени важнее сокращения; сокращение должно
+ * подходить ровно к одной команде, доступной в режиме.
+ * 
+ * @param command Имя команды или его начало
  * @param mode Режим CLI
- * @return int Индекс команды или -1, если не найдена
+ * @return int Индекс команды, -1 если не найдена, -2 если сокращение неоднозначно
  */
 static int cli_find_command(const char *command, cli_mode_t mode) {
-    for (int i = 0; i < command_count; i++) {
-        if (commands[i].is_active && strcmp(commands[i].command, command) == 0 && 
-            (commands[i].mode == mode || commands[i].mode == CLI_MODE_ANY)) {
-            return i;
-        }
+    const cli_trie_node_t *node = cli_trie_walk(command);
+    int found = -1;
+    
+    if (node == NULL) {
+        return -1;
+    }
+    if (node->command >= 0 && cli_command_visible(node->command, mode)) {
+        return node->command;
     }
     
-    return -1;
+    int count = cli_trie_collect(node, mode, &found);
+    if (count > 1) {
+        return -2;
+    }
+    
+    return count == 1 ? found : -1;
 }
 
 /**
@@ -345,14 +501,43 @@ void cli_printf(const char *format, ...) {
     va_list args;
     
     va_start(args, format);
-    vsnprintf(buffer, sizeof(buffer), format, args);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
     va_end(args);
     
+    if (len < 0) {
+        return;
+    }
+    if ((size_t)len >= sizeof(buffer)) {
+        len = sizeof(buffer) - 1;
+    }
+    
+    /* В пакетном режиме вывод копится и отдаётся крупными кусками */
+    if (cli_state.batch) {
+        if (cli_state.batch_output_len + (size_t)len + 1 > cli_state.batch_output_size) {
+            cli_batch_flush();
+        }
+        if ((size_t)len + 1 <= cli_state.batch_output_size) {
+            memcpy(cli_state.batch_output + cli_state.batch_output_len, buffer, (size_t)len + 1);
+            cli_state.batch_output_len += (size_t)len;
+            return;
+        }
+    }
+    
     if (cli_state.output_handler != NULL) {
         cli_state.output_handler(buffer, cli_state.output_context);
     }
 }
 
+/**
+ * @brief Отдача накопленного вывода сценария обработчику вывода
+ */
+static void cli_batch_flush(void) {
+    if (cli_state.batch_output_len > 0 && cli_state.output_handler != NULL) {
+        cli_state.output_handler(cli_state.batch_output, cli_state.output_context);
+    }
+    cli_state.batch_output_len = 0;
+}
+
 /**
  * @brief Обработчик команды help
  * 
@@ -375,11 +560,10 @@ static void cli_handle_help(const char *command) {
     } else {
         /* Поиск команды */
         int idx = cli_find_command(command, current_mode);
-        if (idx == -1) {
-            idx = cli_find_command(command, CLI_MODE_ANY);
-        }
         
-        if (idx >= 0) {
+        if (idx == -2) {
+            cli_printf("Ambiguous command: %s\n", command);
+        } else if (idx >= 0) {
             /* Отображение подробной справки по команде */
             cli_printf("Command: %s\n", commands[idx].command);
             cli_printf("Description: %s\n", commands[idx].description);
@@ -409,19 +593,60 @@ static int cli_tokenize(char *input, char *tokens[], int max_tokens) {
     return count;
 }
 
+/**
+ * @brief Команда режима конфигурации
+ */
+static bool cli_is_config_command(int index) {
+    switch (commands[index].mode) {
+        case CLI_MODE_CONFIG:
+        case CLI_MODE_VLAN:
+        case CLI_MODE_INTERFACE:
+        case CLI_MODE_ROUTING:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Открытие транзакции для группы команд конфигурации сценария
+ * 
+ * Маршруты, заданные командами группы, попадают в FIB одним пакетом.
+ * Если таблица маршрутизации не готова, команды выполняются без транзакции.
+ */
+static void cli_begin_transaction(void) {
+    if (!cli_state.in_transaction && routing_table_begin_batch() == STATUS_SUCCESS) {
+        cli_state.in_transaction = true;
+    }
+}
+
+/**
+ * @brief Закрытие транзакции группы команд конфигурации
+ */
+static void cli_commit_transaction(void) {
+    if (cli_state.in_transaction) {
+        cli_state.in_transaction = false;
+        if (routing_table_commit_batch() != STATUS_SUCCESS) {
+            LOG_ERROR("Failed to commit CLI configuration batch");
+        }
+    }
+}
+
 /**
  * @brief Обработка введенной команды
  * 
  * @param input Строка ввода
+ * @return cli_status_t CLI_STATUS_NOT_FOUND для неизвестной команды,
+ *         CLI_STATUS_INVALID_PARAMETER для неоднозначного сокращения
  */
-static void cli_process_command(const char *input) {
+static cli_status_t cli_process_command(const char *input) {
     char input_copy[MAX_INPUT_LENGTH];
     char *tokens[MAX_CLI_ARGS];
     int token_count;
     
     /* Проверка пустой строки */
     if (input == NULL || strlen(input) == 0) {
-        return;
+        return CLI_STATUS_SUCCESS;
     }
     
     /* Создание копии строки для разбора (strtok модифицирует строку) */
@@ -432,49 +657,61 @@ static void cli_process_command(const char *input) {
     token_count = cli_tokenize(input_copy, tokens, MAX_CLI_ARGS);
     
     if (token_count == 0) {
-        return;
+        return CLI_STATUS_SUCCESS;
     }
     
     /* Получение текущего режима */
     cli_mode_t current_mode = cli_get_current_mode();
     
+    /* Поиск команды по имени или сокращению */
+    int cmd_idx = cli_find_command(tokens[0], current_mode);
+    
+    if (cmd_idx == -2) {
+        cli_printf("Ambiguous command: %s\n", tokens[0]);
+        return CLI_STATUS_INVALID_PARAMETER;
+    }
+    if (cmd_idx == -1) {
+        cli_printf("Unknown command: %s\n", tokens[0]);
+        return CLI_STATUS_NOT_FOUND;
+    }
+    
+    const char *name = commands[cmd_idx].command;
+    
+    /* Группа команд конфигурации сценария кончается на первой другой команде; exit и help её не прерывают */
+    if (cli_state.batch && strcmp(name, "exit") != 0 && strcmp(name, "help") != 0) {
+        if (cli_is_config_command(cmd_idx)) {
+            cli_begin_transaction();
+        } else {
+            cli_commit_transaction();
+        }
+    }
+    
     /* Специальная обработка команды exit */
-    if (strcmp(tokens[0], "exit") == 0) {
+    if (strcmp(name, "exit") == 0) {
         if (current_mode == CLI_MODE_NORMAL) {
             /* Выход из CLI */
             cli_state.is_running = false;
-            return;
         } else {
             /* Возврат к предыдущему режиму */
             cli_exit_mode();
-            return;
         }
+        return CLI_STATUS_SUCCESS;
     }
     
     /* Специальная обработка команды help */
-    if (strcmp(tokens[0], "help") == 0) {
+    if (strcmp(name, "help") == 0) {
         cli_handle_help(token_count > 1 ? tokens[1] : NULL);
-        return;
-    }
-    
-    /* Поиск команды в текущем режиме */
-    int cmd_idx = cli_find_command(tokens[0], current_mode);
-    
-    if (cmd_idx == -1) {
-        /* Попытка найти команду в режиме ANY */
-        cmd_idx = cli_find_command(tokens[0], CLI_MODE_ANY);
+        return CLI_STATUS_SUCCESS;
     }
     
-    if (cmd_idx != -1) {
-        /* Вызов обработчика команды */
-        if (commands[cmd_idx].handler != NULL) {
-            commands[cmd_idx].handler(token_count > 1 ? tokens[1] : NULL);
-        } else {
-            cli_printf("Command '%s' is not implemented yet\n", tokens[0]);
-        }
+    /* Вызов обработчика команды */
+    if (commands[cmd_idx].handler != NULL) {
+        commands[cmd_idx].handler(token_count > 1 ? tokens[1] : NULL);
     } else {
-        cli_printf("Unknown command: %s\n", tokens[0]);
+        cli_printf("Command '%s' is not implemented yet\n", name);
     }
+    
+    return CLI_STATUS_SUCCESS;
 }
 
 /**
@@ -513,6 +750,100 @@ cli_status_t cli_run(void) {
     return CLI_STATUS_SUCCESS;
 }
 
+/**
+ * @brief Выполнение файла команд
+ * 
+ * Строки выполняются по порядку, пустые строки и строки, начинающиеся
+ * с '#', пропускаются. Идущие подряд команды режимов конфигурации
+ * выполняются одной транзакцией, вывод отдаётся обработчику кусками до
+ * CLI_BATCH_OUTPUT_FLUSH байт. Сценарий останавливается на exit в
+ * обычном режиме или в конце файла.
+ * 
+ * @param path Путь к файлу или "-" для стандартного ввода
+ * @param failed Число строк с неизвестной или неоднозначной командой, может быть NULL
+ * @return cli_status_t CLI_STATUS_NOT_FOUND, если файл не открывается
+ */
+cli_status_t cli_run_script(const char *path, int *failed) {
+    char line[MAX_INPUT_LENGTH];
+    int line_number = 0;
+    int failed_lines = 0;
+    FILE *f;
+    
+    if (!cli_initialized) {
+        LOG_ERROR("CLI engine not initialized");
+        return CLI_STATUS_NOT_INITIALIZED;
+    }
+    
+    if (path == NULL) {
+        LOG_ERROR("Invalid script path");
+        return CLI_STATUS_INVALID_PARAMETER;
+    }
+    
+    if (cli_state.batch) {
+        LOG_ERROR("CLI script already running");
+        return CLI_STATUS_INVALID_STATE;
+    }
+    
+    f = (strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+    if (f == NULL) {
+        LOG_ERROR("Failed to open CLI script '%s'", path);
+        return CLI_STATUS_NOT_FOUND;
+    }
+    
+    /* Без буфера вывод идёт напрямую, как в интерактивном режиме */
+    cli_state.batch_output = (char *)malloc(CLI_BATCH_OUTPUT_FLUSH);
+    cli_state.batch_output_size = (cli_state.batch_output != NULL) ? CLI_BATCH_OUTPUT_FLUSH : 0;
+    cli_state.batch_output_len = 0;
+    cli_state.batch = true;
+    cli_state.is_running = true;
+    
+    LOG_INFO("Running CLI script '%s'", path);
+    
+    while (cli_state.is_running && fgets(line, sizeof(line), f) != NULL) {
+        size_t len = strlen(line);
+        line_number++;
+        
+        /* Удаление символов конца строки */
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        
+        const char *command = line;
+        while (isspace((unsigned char)*command)) {
+            command++;
+        }
+        if (*command == '\0' || *command == '#') {
+            continue;
+        }
+        
+        if (cli_process_command(command) != CLI_STATUS_SUCCESS) {
+            cli_printf("  at line %d\n", line_number);
+            failed_lines++;
+        }
+    }
+    
+    cli_commit_transaction();
+    cli_batch_flush();
+    
+    cli_state.batch = false;
+    cli_state.is_running = false;
+    free(cli_state.batch_output);
+    cli_state.batch_output = NULL;
+    cli_state.batch_output_size = 0;
+    
+    if (f != stdin) {
+        fclose(f);
+    }
+    
+    LOG_INFO("CLI script '%s' finished: %d lines, %d failed", path, line_number, failed_lines);
+    
+    if (failed != NULL) {
+        *failed = failed_lines;
+    }
+    
+    return CLI_STATUS_SUCCESS;
+}
+
 /**
  * @brief Деинициализация движка CLI
  * 
@@ -536,6 +867,8 @@ cli_status_t cli_deinitialize(void) {
         }
     }
     
+    cli_trie_free(command_trie);
+    command_trie = NULL;
     command_count = 0;
     cli_initialized = false;
     
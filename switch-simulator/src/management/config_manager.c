@@ -5,6 +5,15 @@
  * Этот модуль отвечает за загрузку, сохранение и управление 
  * конфигурацией коммутатора, поддерживает стартовую и текущую
  * конфигурации, а также операции по их сохранению и восстановлению.
+ *
+ * Текущая конфигурация хранится как модель (config_model_t). Новая
+ * конфигурация сравнивается с ней, и применяются только изменившиеся
+ * объекты, поэтому загрузка конфигурации не сбрасывает таблицы.
+ *
+ * Сохранение стартовой конфигурации только снимает копию текста текущей
+ * конфигурации и отдаёт её потоку сохранения; резервная копия, запись,
+ * fsync и rename идут в нём, не держа блокировку конфигурации. Сохранения,
+ * пришедшие, пока поток занят, сливаются: записывается последняя копия.
  */
 
 #include "management/config_manager.h"
@@ -23,13 +32,15 @@
 #include <errno.h>
 #include <pthread.h>
 #include <time.h>
+#include <unistd.h>
 
 /* Константы */
 #define CONFIG_DIR              "./config"
 #define STARTUP_CONFIG_FILE     CONFIG_DIR "/startup-config.json"
+#define STARTUP_CONFIG_CACHE    CONFIG_DIR "/startup-config.bin"  // Скомпилированная копия
 #define RUNNING_CONFIG_FILE     CONFIG_DIR "/running-config.json"
 #define BACKUP_CONFIG_DIR       CONFIG_DIR "/backups"
-#define MAX_CONFIG_SIZE         (1024 * 1024)  // 1 МБ
+#define MAX_CONFIG_SIZE         (1024 * 1024)  // 1 МБ, начальный размер буфера
 #define MAX_PATH_LENGTH         256
 #define MAX_BACKUP_CONFIGS      10
 
@@ -38,103 +49,151 @@ typedef struct {
     bool initialized;
     char *config_buffer;
     size_t config_buffer_size;
+    size_t config_buffer_capacity;
+    config_model_t running;         // Применённая конфигурация
     pthread_mutex_t config_mutex;
     time_t last_save_time;
     bool config_modified;
+    uint64_t generation;            // Растёт с каждым изменением конфигурации
+
+    // Поток сохранения; поля ниже под save_mutex
+    pthread_t save_thread;
+    pthread_mutex_t save_mutex;
+    pthread_cond_t save_cond;
+    char *save_data;                // Копия, ждущая записи, NULL если нет
+    size_t save_size;
+    uint64_t save_generation;       // Какой конфигурации отвечает копия
+    bool saving;                    // Поток пишет файл
+    bool save_stop;
+    status_t save_status;           // Итог последней записи
 } config_manager_t;
 
 /* Глобальные переменные */
 static config_manager_t g_config_manager = {0};
 
 /* Локальные функции */
-static sw_error_t create_config_directories(void);
-static sw_error_t load_config_from_file(const char *filename, char **config_data, size_t *data_size);
-static sw_error_t save_config_to_file(const char *filename, const char *config_data, size_t data_size);
-static sw_error_t create_backup_config(void);
-static sw_error_t parse_config_json(const char *config_data, size_t data_size);
-static sw_error_t generate_config_json(char **config_data, size_t *data_size);
+static status_t create_config_directories(void);
+static status_t save_config_to_file(const char *filename, const char *config_data, size_t data_size);
+static status_t create_backup_config(void);
+static status_t load_startup_config_locked(void);
+static status_t parse_config_json(const char *config_data, size_t data_size, config_diff_stats_t *stats);
+static status_t apply_config_model(config_model_t *target, config_diff_stats_t *stats);
+static status_t generate_config_json(char **config_data, size_t *data_size);
+static void *save_thread_main(void *arg);
 
 /**
  * @brief Инициализация менеджера конфигурации
  * 
- * @return SW_OK если успешно, иначе код ошибки
+ * @return STATUS_SUCCESS если успешно, иначе код ошибки
  */
-sw_error_t config_manager_init(void) {
-    sw_error_t err;
+status_t config_manager_init(void) {
+    status_t err;
 
     if (g_config_manager.initialized) {
-        LOG_WARN("Config manager already initialized");
-        return SW_OK;
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Config manager already initialized");
+        return STATUS_SUCCESS;
     }
 
     // Создаем директории для конфигурации
     err = create_config_directories();
-    if (err != SW_OK) {
-        LOG_ERROR("Failed to create config directories, error: %d", err);
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to create config directories, error: %d", err);
         return err;
     }
 
     // Инициализируем мьютекс
     if (pthread_mutex_init(&g_config_manager.config_mutex, NULL) != 0) {
-        LOG_ERROR("Failed to initialize config mutex");
-        return SW_ERROR_INIT_FAILED;
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to initialize config mutex");
+        return STATUS_GENERAL_ERROR;
     }
 
     // Выделяем буфер для конфигурации
     g_config_manager.config_buffer = (char *)malloc(MAX_CONFIG_SIZE);
     if (g_config_manager.config_buffer == NULL) {
-        LOG_ERROR("Failed to allocate memory for config buffer");
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to allocate memory for config buffer");
         pthread_mutex_destroy(&g_config_manager.config_mutex);
-        return SW_ERROR_NO_MEMORY;
+        return STATUS_NO_MEMORY;
     }
     g_config_manager.config_buffer_size = 0;
+    g_config_manager.config_buffer_capacity = MAX_CONFIG_SIZE;
 
-    // Загружаем стартовую конфигурацию
-    err = config_manager_load_startup_config();
-    if (err != SW_OK && err != SW_ERROR_FILE_NOT_FOUND) {
-        LOG_ERROR("Failed to load startup config, error: %d", err);
+    config_model_init(&g_config_manager.running);
+
+    // Загружаем стартовую конфигурацию; менеджер ещё никому не виден, блокировка не нужна
+    err = load_startup_config_locked();
+    if (err != STATUS_SUCCESS && err != STATUS_NOT_FOUND) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to load startup config, error: %d", err);
+        config_model_free(&g_config_manager.running);
         free(g_config_manager.config_buffer);
         pthread_mutex_destroy(&g_config_manager.config_mutex);
         return err;
     }
 
     // Если стартовая конфигурация не найдена, создаем пустую
-    if (err == SW_ERROR_FILE_NOT_FOUND) {
-        LOG_INFO("No startup config found, using default configuration");
+    if (err == STATUS_NOT_FOUND) {
+        LOG_INFO(LOG_CATEGORY_SYSTEM, "No startup config found, using default configuration");
         // Генерируем пустую конфигурацию
         err = generate_config_json(&g_config_manager.config_buffer, &g_config_manager.config_buffer_size);
-        if (err != SW_OK) {
-            LOG_ERROR("Failed to generate default config, error: %d", err);
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to generate default config, error: %d", err);
+            config_model_free(&g_config_manager.running);
             free(g_config_manager.config_buffer);
             pthread_mutex_destroy(&g_config_manager.config_mutex);
             return err;
         }
     }
 
+    // Запускаем поток сохранения
+    pthread_mutex_init(&g_config_manager.save_mutex, NULL);
+    pthread_cond_init(&g_config_manager.save_cond, NULL);
+    g_config_manager.save_data = NULL;
+    g_config_manager.saving = false;
+    g_config_manager.save_stop = false;
+    g_config_manager.save_status = STATUS_SUCCESS;
+    if (pthread_create(&g_config_manager.save_thread, NULL, save_thread_main, NULL) != 0) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to start config save thread");
+        pthread_cond_destroy(&g_config_manager.save_cond);
+        pthread_mutex_destroy(&g_config_manager.save_mutex);
+        config_model_free(&g_config_manager.running);
+        free(g_config_manager.config_buffer);
+        pthread_mutex_destroy(&g_config_manager.config_mutex);
+        return STATUS_GENERAL_ERROR;
+    }
+
     g_config_manager.last_save_time = time(NULL);
     g_config_manager.config_modified = false;
+    g_config_manager.generation = 0;
     g_config_manager.initialized = true;
 
-    LOG_INFO("Config manager initialized successfully");
-    return SW_OK;
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Config manager initialized successfully");
+    return STATUS_SUCCESS;
 }
 
 /**
  * @brief Деинициализация менеджера конфигурации
  * 
- * @return SW_OK если успешно, иначе код ошибки
+ * @return STATUS_SUCCESS если успешно, иначе код ошибки
  */
-sw_error_t config_manager_deinit(void) {
+status_t config_manager_deinit(void) {
     if (!g_config_manager.initialized) {
-        LOG_WARN("Config manager not initialized");
-        return SW_OK;
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Config manager not initialized");
+        return STATUS_SUCCESS;
     }
 
+    // Дописываем ожидающее сохранение и останавливаем поток
+    pthread_mutex_lock(&g_config_manager.save_mutex);
+    g_config_manager.save_stop = true;
+    pthread_cond_broadcast(&g_config_manager.save_cond);
+    pthread_mutex_unlock(&g_config_manager.save_mutex);
+    pthread_join(g_config_manager.save_thread, NULL);
+    pthread_cond_destroy(&g_config_manager.save_cond);
+    pthread_mutex_destroy(&g_config_manager.save_mutex);
+
     pthread_mutex_lock(&g_config_manager.config_mutex);
 
     // Сохраняем текущую конфигурацию при выходе
     if (g_config_manager.config_modified) {
-        LOG_INFO("Saving modified configuration before shutdown");
+        LOG_INFO(LOG_CATEGORY_SYSTEM, "Saving modified configuration before shutdown");
         save_config_to_file(RUNNING_CONFIG_FILE, 
                            g_config_manager.config_buffer, 
                            g_config_manager.config_buffer_size);
@@ -143,199 +202,254 @@ sw_error_t config_manager_deinit(void) {
     free(g_config_manager.config_buffer);
     g_config_manager.config_buffer = NULL;
     g_config_manager.config_buffer_size = 0;
+    g_config_manager.config_buffer_capacity = 0;
+    config_model_free(&g_config_manager.running);
     g_config_manager.initialized = false;
 
     pthread_mutex_unlock(&g_config_manager.config_mutex);
     pthread_mutex_destroy(&g_config_manager.config_mutex);
 
-    LOG_INFO("Config manager deinitialized successfully");
-    return SW_OK;
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Config manager deinitialized successfully");
+    return STATUS_SUCCESS;
 }
 
 /**
  * @brief Загрузка стартовой конфигурации
  * 
- * @return SW_OK если успешно, иначе код ошибки
+ * @return STATUS_SUCCESS если успешно, иначе код ошибки
  */
-sw_error_t config_manager_load_startup_config(void) {
-    sw_error_t err;
-    char *config_data = NULL;
-    size_t data_size = 0;
+status_t config_manager_load_startup_config(void) {
+    status_t err;
 
     if (!g_config_manager.initialized) {
-        LOG_ERROR("Config manager not initialized");
-        return SW_ERROR_NOT_INITIALIZED;
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Config manager not initialized");
+        return STATUS_NOT_INITIALIZED;
     }
 
     pthread_mutex_lock(&g_config_manager.config_mutex);
+    err = load_startup_config_locked();
+    pthread_mutex_unlock(&g_config_manager.config_mutex);
+    return err;
+}
 
-    // Загружаем файл стартовой конфигурации
-    err = load_config_from_file(STARTUP_CONFIG_FILE, &config_data, &data_size);
-    if (err != SW_OK) {
-        pthread_mutex_unlock(&g_config_manager.config_mutex);
+/**
+ * @brief Загрузка и применение стартовой конфигурации под блокировкой
+ * 
+ * @return STATUS_SUCCESS если успешно, иначе код ошибки
+ */
+static status_t load_startup_config_locked(void) {
+    config_model_t target;
+    bool cached = false;
+    status_t err;
+
+    // Файл читается по частям; если он не менялся, берётся скомпилированная копия
+    config_model_init(&target);
+    err = config_model_load_file(&target, STARTUP_CONFIG_FILE, STARTUP_CONFIG_CACHE, &cached);
+    if (err == STATUS_NOT_FOUND) {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Config file not found: %s", STARTUP_CONFIG_FILE);
         return err;
     }
-
-    // Парсим JSON-конфигурацию и применяем настройки
-    err = parse_config_json(config_data, data_size);
-    if (err != SW_OK) {
-        LOG_ERROR("Failed to parse startup config, error: %d", err);
-        free(config_data);
-        pthread_mutex_unlock(&g_config_manager.config_mutex);
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to parse startup config, error: %d", err);
         return err;
     }
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Startup config read%s: %u VLANs, %u routes",
+             cached ? " from compiled copy" : "", target.vlan_count, target.route_count);
 
-    // Копируем конфигурацию в буфер менеджера
-    if (data_size <= MAX_CONFIG_SIZE) {
-        memcpy(g_config_manager.config_buffer, config_data, data_size);
-        g_config_manager.config_buffer_size = data_size;
-    } else {
-        LOG_ERROR("Config file too large, max size: %d bytes", MAX_CONFIG_SIZE);
-        free(config_data);
-        pthread_mutex_unlock(&g_config_manager.config_mutex);
-        return SW_ERROR_BUFFER_OVERFLOW;
+    // Применяем отличия от текущей конфигурации (при старте — всю конфигурацию)
+    err = apply_config_model(&target, NULL);
+    config_model_free(&target);
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to apply startup config, error: %d", err);
+        return err;
     }
 
-    free(config_data);
     g_config_manager.config_modified = false;
     g_config_manager.last_save_time = time(NULL);
 
-    LOG_INFO("Startup configuration loaded successfully");
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Startup configuration loaded successfully");
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Применение конфигурации в формате JSON
+ * 
+ * @param config_data Данные конфигурации
+ * @param data_size Размер данных конфигурации
+ * @param stats Внесённые изменения, может быть NULL
+ * @return STATUS_SUCCESS если успешно, иначе код ошибки
+ */
+status_t config_manager_apply_json(const char *config_data, size_t data_size, config_diff_stats_t *stats) {
+    status_t err;
+
+    if (!g_config_manager.initialized) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Config manager not initialized");
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (config_data == NULL) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_config_manager.config_mutex);
+    err = parse_config_json(config_data, data_size, stats);
+    if (err == STATUS_SUCCESS) {
+        g_config_manager.config_modified = true;
+        g_config_manager.generation++;
+    }
     pthread_mutex_unlock(&g_config_manager.config_mutex);
-    return SW_OK;
+    return err;
 }
 
 /**
  * @brief Сохранение текущей конфигурации как стартовой
+ *
+ * Снимает копию текущей конфигурации и ставит её в очередь потоку
+ * сохранения; файл записывается позже. Итог записи возвращает
+ * config_manager_wait_for_save().
  * 
- * @return SW_OK если успешно, иначе код ошибки
+ * @return STATUS_SUCCESS если копия поставлена в очередь, иначе код ошибки
  */
-sw_error_t config_manager_save_startup_config(void) {
-    sw_error_t err;
+status_t config_manager_save_startup_config(void) {
+    char *snapshot;
+    size_t size;
+    uint64_t generation;
 
     if (!g_config_manager.initialized) {
-        LOG_ERROR("Config manager not initialized");
-        return SW_ERROR_NOT_INITIALIZED;
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Config manager not initialized");
+        return STATUS_NOT_INITIALIZED;
     }
 
+    // Под блокировкой только копируем текст текущей конфигурации
     pthread_mutex_lock(&g_config_manager.config_mutex);
-
-    // Создаем резервную копию текущей стартовой конфигурации
-    err = create_backup_config();
-    if (err != SW_OK) {
-        LOG_WARN("Failed to create backup config, error: %d", err);
-        // Продолжаем выполнение даже при ошибке резервного копирования
+    size = g_config_manager.config_buffer_size;
+    generation = g_config_manager.generation;
+    snapshot = (char *)malloc(size > 0 ? size : 1);
+    if (snapshot != NULL) {
+        memcpy(snapshot, g_config_manager.config_buffer, size);
     }
+    pthread_mutex_unlock(&g_config_manager.config_mutex);
 
-    // Сохраняем текущую конфигурацию как стартовую
-    err = save_config_to_file(STARTUP_CONFIG_FILE, 
-                             g_config_manager.config_buffer, 
-                             g_config_manager.config_buffer_size);
-    if (err != SW_OK) {
-        LOG_ERROR("Failed to save startup config, error: %d", err);
-        pthread_mutex_unlock(&g_config_manager.config_mutex);
-        return err;
+    if (snapshot == NULL) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to allocate memory for config snapshot");
+        return STATUS_NO_MEMORY;
     }
 
-    g_config_manager.config_modified = false;
-    g_config_manager.last_save_time = time(NULL);
+    // Более старая ещё не записанная копия больше не нужна
+    pthread_mutex_lock(&g_config_manager.save_mutex);
+    free(g_config_manager.save_data);
+    g_config_manager.save_data = snapshot;
+    g_config_manager.save_size = size;
+    g_config_manager.save_generation = generation;
+    pthread_cond_broadcast(&g_config_manager.save_cond);
+    pthread_mutex_unlock(&g_config_manager.save_mutex);
 
-    LOG_INFO("Current configuration saved as startup configuration");
-    pthread_mutex_unlock(&g_config_manager.config_mutex);
-    return SW_OK;
+    LOG_DEBUG(LOG_CATEGORY_SYSTEM, "Startup configuration save queued (%zu bytes)", size);
+    return STATUS_SUCCESS;
 }
 
 /**
- * @brief Создание директорий для конфигурации
+ * @brief Ожидание записи поставленных в очередь сохранений
  * 
- * @return SW_OK если успешно, иначе код ошибки
+ * @return Итог последней записи стартовой конфигурации
  */
-static sw_error_t create_config_directories(void) {
-    // Создаем основную директорию для конфигурации
-    if (mkdir(CONFIG_DIR, 0755) != 0 && errno != EEXIST) {
-        LOG_ERROR("Failed to create config directory, errno: %d", errno);
-        return SW_ERROR_IO;
-    }
+status_t config_manager_wait_for_save(void) {
+    status_t err;
 
-    // Создаем директорию для резервных копий
-    if (mkdir(BACKUP_CONFIG_DIR, 0755) != 0 && errno != EEXIST) {
-        LOG_ERROR("Failed to create backup config directory, errno: %d", errno);
-        return SW_ERROR_IO;
+    if (!g_config_manager.initialized) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Config manager not initialized");
+        return STATUS_NOT_INITIALIZED;
     }
 
-    return SW_OK;
+    pthread_mutex_lock(&g_config_manager.save_mutex);
+    while (g_config_manager.save_data != NULL || g_config_manager.saving) {
+        pthread_cond_wait(&g_config_manager.save_cond, &g_config_manager.save_mutex);
+    }
+    err = g_config_manager.save_status;
+    pthread_mutex_unlock(&g_config_manager.save_mutex);
+    return err;
 }
 
 /**
- * @brief Загрузка конфигурации из файла
+ * @brief Поток сохранения стартовой конфигурации
+ *
+ * Берёт последнюю поставленную копию и записывает её, не держа
+ * блокировку конфигурации. При остановке дописывает ожидающую копию.
  * 
- * @param filename Имя файла конфигурации
- * @param config_data Указатель на буфер, который будет выделен для конфигурации
- * @param data_size Размер загруженной конфигурации
- * @return SW_OK если успешно, иначе код ошибки
+ * @param arg Не используется
+ * @return NULL
  */
-static sw_error_t load_config_from_file(const char *filename, char **config_data, size_t *data_size) {
-    FILE *f;
-    size_t file_size;
-    char *buffer;
+static void *save_thread_main(void *arg) {
+    (void)arg;
 
-    if (filename == NULL || config_data == NULL || data_size == NULL) {
-        return SW_ERROR_INVALID_PARAMETER;
-    }
+    pthread_mutex_lock(&g_config_manager.save_mutex);
+    for (;;) {
+        while (g_config_manager.save_data == NULL && !g_config_manager.save_stop) {
+            pthread_cond_wait(&g_config_manager.save_cond, &g_config_manager.save_mutex);
+        }
+        if (g_config_manager.save_data == NULL) {
+            break;
+        }
 
-    f = fopen(filename, "rb");
-    if (f == NULL) {
-        if (errno == ENOENT) {
-            LOG_WARN("Config file not found: %s", filename);
-            return SW_ERROR_FILE_NOT_FOUND;
-        } else {
-            LOG_ERROR("Failed to open config file: %s, errno: %d", filename, errno);
-            return SW_ERROR_IO;
+        char *data = g_config_manager.save_data;
+        size_t size = g_config_manager.save_size;
+        uint64_t generation = g_config_manager.save_generation;
+        g_config_manager.save_data = NULL;
+        g_config_manager.saving = true;
+        pthread_mutex_unlock(&g_config_manager.save_mutex);
+
+        // Создаем резервную копию текущей стартовой конфигурации
+        status_t err = create_backup_config();
+        if (err != STATUS_SUCCESS) {
+            LOG_WARNING(LOG_CATEGORY_SYSTEM, "Failed to create backup config, error: %d", err);
+            // Продолжаем выполнение даже при ошибке резервного копирования
         }
-    }
 
-    // Определяем размер файла
-    fseek(f, 0, SEEK_END);
-    file_size = ftell(f);
-    fseek(f, 0, SEEK_SET);
+        // Сохраняем копию как стартовую конфигурацию
+        err = save_config_to_file(STARTUP_CONFIG_FILE, data, size);
+        free(data);
+        if (err != STATUS_SUCCESS) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to save startup config, error: %d", err);
+        } else {
+            // Конфигурация могла измениться, пока шла запись
+            pthread_mutex_lock(&g_config_manager.config_mutex);
+            if (g_config_manager.generation == generation) {
+                g_config_manager.config_modified = false;
+            }
+            g_config_manager.last_save_time = time(NULL);
+            pthread_mutex_unlock(&g_config_manager.config_mutex);
+            LOG_INFO(LOG_CATEGORY_SYSTEM, "Current configuration saved as startup configuration");
+        }
 
-    if (file_size == 0) {
-        LOG_WARN("Config file is empty: %s", filename);
-        fclose(f);
-        return SW_ERROR_EMPTY_FILE;
+        pthread_mutex_lock(&g_config_manager.save_mutex);
+        g_config_manager.saving = false;
+        g_config_manager.save_status = err;
+        pthread_cond_broadcast(&g_config_manager.save_cond);
     }
+    pthread_mutex_unlock(&g_config_manager.save_mutex);
 
-    if (file_size > MAX_CONFIG_SIZE) {
-        LOG_ERROR("Config file too large: %s, size: %zu bytes, max: %d bytes", 
-                  filename, file_size, MAX_CONFIG_SIZE);
-        fclose(f);
-        return SW_ERROR_BUFFER_OVERFLOW;
-    }
+    return NULL;
+}
 
-    // Выделяем память для конфигурации
-    buffer = (char *)malloc(file_size + 1);
-    if (buffer == NULL) {
-        LOG_ERROR("Failed to allocate memory for config file: %s", filename);
-        fclose(f);
-        return SW_ERROR_NO_MEMORY;
+/**
+ * @brief Создание директорий для конфигурации
+ * 
+ * @return STATUS_SUCCESS если успешно, иначе код ошибки
+ */
+static status_t create_config_directories(void) {
+    // Создаем основную директорию для конфигурации
+    if (mkdir(CONFIG_DIR, 0755) != 0 && errno != EEXIST) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to create config directory, errno: %d", errno);
+        return ERROR_IO_ERROR;
     }
 
-    // Читаем файл
-    if (fread(buffer, 1, file_size, f) != file_size) {
-        LOG_ERROR("Failed to read config file: %s", filename);
-        free(buffer);
-        fclose(f);
-        return SW_ERROR_IO;
+    // Создаем директорию для резервных копий
+    if (mkdir(BACKUP_CONFIG_DIR, 0755) != 0 && errno != EEXIST) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to create backup config directory, errno: %d", errno);
+        return ERROR_IO_ERROR;
     }
 
-    // Добавляем нулевой байт в конец строки
-    buffer[file_size] = '\0';
-    
-    *config_data = buffer;
-    *data_size = file_size;
-
-    fclose(f);
-    return SW_OK;
+    return STATUS_SUCCESS;
 }
 
 /**
@@ -344,40 +458,45 @@ static sw_error_t load_config_from_file(const char *filename, char **config_data
  * @param filename Имя файла конфигурации
  * @param config_data Данные конфигурации
  * @param data_size Размер данных конфигурации
- * @return SW_OK если успешно, иначе код ошибки
+ * @return STATUS_SUCCESS если успешно, иначе код ошибки
  */
-static sw_error_t save_config_to_file(const char *filename, const char *config_data, size_t data_size) {
+static status_t save_config_to_file(const char *filename, const char *config_data, size_t data_size) {
+    char tmp_filename[MAX_PATH_LENGTH];
     FILE *f;
+    bool ok;
 
     if (filename == NULL || config_data == NULL || data_size == 0) {
-        return SW_ERROR_INVALID_PARAMETER;
+        return STATUS_INVALID_PARAMETER;
     }
 
-    f = fopen(filename, "wb");
+    // Пишем во временный файл и подменяем им старый: файл всегда целый
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+    f = fopen(tmp_filename, "wb");
     if (f == NULL) {
-        LOG_ERROR("Failed to open config file for writing: %s, errno: %d", filename, errno);
-        return SW_ERROR_IO;
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to open config file for writing: %s, errno: %d", tmp_filename, errno);
+        return ERROR_IO_ERROR;
     }
 
-    if (fwrite(config_data, 1, data_size, f) != data_size) {
-        LOG_ERROR("Failed to write config file: %s", filename);
-        fclose(f);
-        return SW_ERROR_IO;
+    ok = fwrite(config_data, 1, data_size, f) == data_size && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp_filename, filename) != 0) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to write config file: %s, errno: %d", filename, errno);
+        unlink(tmp_filename);
+        return ERROR_IO_ERROR;
     }
 
-    fclose(f);
-    return SW_OK;
+    return STATUS_SUCCESS;
 }
 
 /**
  * @brief Создание резервной копии текущей стартовой конфигурации
  * 
- * @return SW_OK если успешно, иначе код ошибки
+ * @return STATUS_SUCCESS если успешно, иначе код ошибки
  */
-static sw_error_t create_backup_config(void) {
+static status_t create_backup_config(void) {
     char backup_filename[MAX_PATH_LENGTH];
     time_t current_time;
-    struct tm *time_info;
+    struct tm time_info;
     FILE *src, *dst;
     char buffer[4096];
     size_t bytes_read;
@@ -387,53 +506,112 @@ static sw_error_t create_backup_config(void) {
     if (stat(STARTUP_CONFIG_FILE, &st) != 0) {
         if (errno == ENOENT) {
             // Файл не существует, резервное копирование не требуется
-            return SW_OK;
+            return STATUS_SUCCESS;
         } else {
-            LOG_ERROR("Failed to check startup config file, errno: %d", errno);
-            return SW_ERROR_IO;
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to check startup config file, errno: %d", errno);
+            return ERROR_IO_ERROR;
         }
     }
 
     // Создаем имя файла резервной копии с текущей датой и временем
     current_time = time(NULL);
-    time_info = localtime(&current_time);
+    localtime_r(&current_time, &time_info);
     snprintf(backup_filename, MAX_PATH_LENGTH, 
              "%s/startup-config-%04d%02d%02d-%02d%02d%02d.json",
              BACKUP_CONFIG_DIR,
-             time_info->tm_year + 1900, time_info->tm_mon + 1, time_info->tm_mday,
-             time_info->tm_hour, time_info->tm_min, time_info->tm_sec);
+             time_info.tm_year + 1900, time_info.tm_mon + 1, time_info.tm_mday,
+             time_info.tm_hour, time_info.tm_min, time_info.tm_sec);
 
     // Открываем исходный файл
     src = fopen(STARTUP_CONFIG_FILE, "rb");
     if (src == NULL) {
-        LOG_ERROR("Failed to open startup config for backup, errno: %d", errno);
-        return SW_ERROR_IO;
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to open startup config for backup, errno: %d", errno);
+        return ERROR_IO_ERROR;
     }
 
     // Открываем файл резервной копии
     dst = fopen(backup_filename, "wb");
     if (dst == NULL) {
-        LOG_ERROR("Failed to create backup config file: %s, errno: %d", 
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to create backup config file: %s, errno: %d", 
                   backup_filename, errno);
         fclose(src);
-        return SW_ERROR_IO;
+        return ERROR_IO_ERROR;
     }
 
     // Копируем данные
     while ((bytes_read = fread(buffer, 1, sizeof(buffer), src)) > 0) {
         if (fwrite(buffer, 1, bytes_read, dst) != bytes_read) {
-            LOG_ERROR("Failed to write to backup file: %s", backup_filename);
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to write to backup file: %s", backup_filename);
             fclose(src);
             fclose(dst);
-            return SW_ERROR_IO;
+            return ERROR_IO_ERROR;
         }
     }
 
     fclose(src);
     fclose(dst);
 
-    LOG_INFO("Created backup of startup config: %s", backup_filename);
-    return SW_OK;
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Created backup of startup config: %s", backup_filename);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Применение модели конфигурации
+ *
+ * Применяются только отличия от текущей конфигурации. При успехе модель
+ * становится текущей, а буфер конфигурации перестраивается по ней; при
+ * ошибке текущей остаётся прежняя модель, и повторное применение
+ * повторит все отличия.
+ * 
+ * @param target Новая конфигурация; если она применена, её массивы переходят
+ *               менеджеру, а сама она становится пустой
+ * @param stats Внесённые изменения, может быть NULL
+ * @return STATUS_SUCCESS если успешно, иначе код ошибки
+ */
+static status_t apply_config_model(config_model_t *target, config_diff_stats_t *stats) {
+    config_diff_stats_t own_stats;
+    status_t err;
+
+    if (stats == NULL) {
+        stats = &own_stats;
+    }
+
+    err = config_model_apply(&g_config_manager.running, target, stats);
+    LOG_INFO(LOG_CATEGORY_SYSTEM,
+             "Config applied in %llu us: ports +%u/-%u, VLANs +%u/-%u/~%u, members +%u/-%u, "
+             "routes +%u/-%u, failed %u",
+             (unsigned long long)stats->elapsed_us, stats->ports_enabled, stats->ports_disabled,
+             stats->vlans_created, stats->vlans_deleted, stats->vlans_renamed,
+             stats->members_added, stats->members_removed, stats->routes_added, stats->routes_removed,
+             stats->failed);
+    if (err != STATUS_SUCCESS) {
+        return err;
+    }
+
+    config_model_free(&g_config_manager.running);
+    g_config_manager.running = *target;
+    config_model_init(target);
+
+    // Буфер растёт вместе с конфигурацией
+    for (;;) {
+        err = config_model_render(&g_config_manager.running, g_config_manager.config_buffer,
+                                  g_config_manager.config_buffer_capacity, &g_config_manager.config_buffer_size);
+        if (err != STATUS_RESOURCE_EXCEEDED) {
+            break;
+        }
+
+        size_t capacity = g_config_manager.config_buffer_capacity * 2;
+        char *buffer = (char *)realloc(g_config_manager.config_buffer, capacity);
+        if (buffer == NULL) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Running config does not fit in %zu bytes",
+                      g_config_manager.config_buffer_capacity);
+            g_config_manager.config_buffer_size = 0;
+            return STATUS_NO_MEMORY;
+        }
+        g_config_manager.config_buffer = buffer;
+        g_config_manager.config_buffer_capacity = capacity;
+    }
+    return err;
 }
 
 /**
@@ -441,18 +619,23 @@ static sw_error_t create_backup_config(void) {
  * 
  * @param config_data Данные конфигурации в формате JSON
  * @param data_size Размер данных конфигурации
- * @return SW_OK если успешно, иначе код ошибки
+ * @param stats Внесённые изменения, может быть NULL
+ * @return STATUS_SUCCESS если успешно, иначе код ошибки
  */
-static sw_error_t parse_config_json(const char *config_data, size_t data_size) {
-    // Здесь должен быть код для парсинга JSON и применения конфигурации
-    // В реальном проекте здесь будет использована библиотека для работы с JSON
-    // и вызовы API различных модулей для настройки коммутатора
-    
-    // Примечание: Эта функция является заглушкой и должна быть доработана
-    // в соответствии с требованиями к формату конфигурации
+static status_t parse_config_json(const char *config_data, size_t data_size, config_diff_stats_t *stats) {
+    config_model_t target;
+    status_t err;
+
+    // Сначала разбираем всю конфигурацию: ошибка разбора ничего не меняет
+    config_model_init(&target);
+    err = config_model_parse(&target, config_data, data_size);
+    if (err != STATUS_SUCCESS) {
+        return err;
+    }
 
-    LOG_INFO("Parsed and applied configuration (placeholder)");
-    return SW_OK;
+    err = apply_config_model(&target, stats);
+    config_model_free(&target);
+    return err;
 }
 
 /**
@@ -460,9 +643,9 @@ static sw_error_t parse_config_json(const char *config_data, size_t data_size) {
  * 
  * @param config_data Указатель на буфер для сохранения конфигурации
  * @param data_size Размер сгенерированной конфигурации
- * @return SW_OK если успешно, иначе код ошибки
+ * @return STATUS_SUCCESS если успешно, иначе код ошибки
  */
-static sw_error_t generate_config_json(char **config_data, size_t *data_size) {
+static status_t generate_config_json(char **config_data, size_t *data_size) {
     // Здесь должен быть код для генерации JSON из текущей конфигурации
     // В реальном проекте здесь будут вызовы API различных модулей
     // для получения их текущих настроек и формирования JSON
@@ -495,14 +678,14 @@ static sw_error_t generate_config_json(char **config_data, size_t *data_size) {
         size_t len = strlen(default_config);
         *config_data = (char *)malloc(len + 1);
         if (*config_data == NULL) {
-            return SW_ERROR_NO_MEMORY;
+            return STATUS_NO_MEMORY;
         }
         strcpy(*config_data, default_config);
         *data_size = len;
     }
 
-    LOG_INFO("Generated default configuration (placeholder)");
-    return SW_OK;
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Generated default configuration (placeholder)");
+    return STATUS_SUCCESS;
 }
 
 /**
@@ -510,32 +693,41 @@ static sw_error_t generate_config_json(char **config_data, size_t *data_size) {
  * 
  * @param key Путь к параметру конфигурации (в формате "раздел.параметр")
  * @param value Значение параметра
- * @return SW_OK если успешно, иначе код ошибки
+ * @return STATUS_SUCCESS если успешно, иначе код ошибки
  */
-sw_error_t config_manager_set_param(const char *key, const char *value) {
+status_t config_manager_set_param(const char *key, const char *value) {
     if (!g_config_manager.initialized) {
-        LOG_ERROR("Config manager not initialized");
-        return SW_ERROR_NOT_INITIALIZED;
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Config manager not initialized");
+        return STATUS_NOT_INITIALIZED;
     }
 
     if (key == NULL || value == NULL) {
-        return SW_ERROR_INVALID_PARAMETER;
+        return STATUS_INVALID_PARAMETER;
     }
 
     pthread_mutex_lock(&g_config_manager.config_mutex);
 
-    // Здесь должен быть код для установки параметра в конфигурации
-    // В реальном проекте здесь будет поиск нужного параметра в JSON
-    // и его модификация
-
-    // Примечание: Эта функция является заглушкой и должна быть доработана
-    // в соответствии с требованиями к формату конфигурации
+    // Меняем копию текущей конфигурации и применяем только отличие
+    config_model_t target;
+    status_t err = config_model_copy(&target, &g_config_manager.running);
+    if (err == STATUS_SUCCESS) {
+        err = config_model_set(&target, key, value);
+        if (err == STATUS_SUCCESS) {
+            err = apply_config_model(&target, NULL);
+        }
+        config_model_free(&target);
+    }
 
-    LOG_INFO("Set config parameter: %s = %s (placeholder)", key, value);
-    g_config_manager.config_modified = true;
+    if (err == STATUS_SUCCESS) {
+        LOG_INFO(LOG_CATEGORY_SYSTEM, "Set config parameter: %s = %s", key, value);
+        g_config_manager.config_modified = true;
+        g_config_manager.generation++;
+    } else {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to set config parameter %s, error: %d", key, err);
+    }
 
     pthread_mutex_unlock(&g_config_manager.config_mutex);
-    return SW_OK;
+    return err;
 }
 
 /**
@@ -544,80 +736,69 @@ sw_error_t config_manager_set_param(const char *key, const char *value) {
  * @param key Путь к параметру конфигурации (в формате "раздел.параметр")
  * @param value Буфер для значения параметра
  * @param value_size Размер буфера
- * @return SW_OK если успешно, иначе код ошибки
+ * @return STATUS_SUCCESS если успешно, иначе код ошибки
  */
-sw_error_t config_manager_get_param(const char *key, char *value, size_t value_size) {
+status_t config_manager_get_param(const char *key, char *value, size_t value_size) {
     if (!g_config_manager.initialized) {
-        LOG_ERROR("Config manager not initialized");
-        return SW_ERROR_NOT_INITIALIZED;
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Config manager not initialized");
+        return STATUS_NOT_INITIALIZED;
     }
 
     if (key == NULL || value == NULL || value_size == 0) {
-        return SW_ERROR_INVALID_PARAMETER;
+        return STATUS_INVALID_PARAMETER;
     }
 
     pthread_mutex_lock(&g_config_manager.config_mutex);
-
-    // Здесь должен быть код для получения параметра из конфигурации
-    // В реальном проекте здесь будет поиск нужного параметра в JSON
-
-    // Примечание: Эта функция является заглушкой и должна быть доработана
-    // в соответствии с требованиями к формату конфигурации
-
-    // Для демонстрации возвращаем фиктивное значение
-    strncpy(value, "placeholder_value", value_size - 1);
-    value[value_size - 1] = '\0';
-
-    LOG_INFO("Get config parameter: %s (placeholder)", key);
-
+    status_t err = config_model_get(&g_config_manager.running, key, value, value_size);
     pthread_mutex_unlock(&g_config_manager.config_mutex);
-    return SW_OK;
+    return err;
 }
 
 /**
  * @brief Восстановление конфигурации по умолчанию
  * 
- * @return SW_OK если успешно, иначе код ошибки
+ * @return STATUS_SUCCESS если успешно, иначе код ошибки
  */
-sw_error_t config_manager_reset_to_defaults(void) {
-    sw_error_t err;
+status_t config_manager_reset_to_defaults(void) {
+    status_t err;
 
     if (!g_config_manager.initialized) {
-        LOG_ERROR("Config manager not initialized");
-        return SW_ERROR_NOT_INITIALIZED;
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Config manager not initialized");
+        return STATUS_NOT_INITIALIZED;
     }
 
     pthread_mutex_lock(&g_config_manager.config_mutex);
 
     // Создаем резервную копию текущей конфигурации
     err = create_backup_config();
-    if (err != SW_OK) {
-        LOG_WARN("Failed to create backup config, error: %d", err);
+    if (err != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Failed to create backup config, error: %d", err);
         // Продолжаем выполнение даже при ошибке резервного копирования
     }
 
     // Генерируем конфигурацию по умолчанию
     err = generate_config_json(&g_config_manager.config_buffer, &g_config_manager.config_buffer_size);
-    if (err != SW_OK) {
-        LOG_ERROR("Failed to generate default config, error: %d", err);
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to generate default config, error: %d", err);
         pthread_mutex_unlock(&g_config_manager.config_mutex);
         return err;
     }
 
-    // Применяем конфигурацию
-    err = parse_config_json(g_config_manager.config_buffer, g_config_manager.config_buffer_size);
-    if (err != SW_OK) {
-        LOG_ERROR("Failed to apply default config, error: %d", err);
+    // Применяем конфигурацию: меняется только отличающееся от текущей
+    err = parse_config_json(g_config_manager.config_buffer, g_config_manager.config_buffer_size, NULL);
+    if (err != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Failed to apply default config, error: %d", err);
         pthread_mutex_unlock(&g_config_manager.config_mutex);
         return err;
     }
 
     g_config_manager.config_modified = true;
+    g_config_manager.generation++;
     g_config_manager.last_save_time = time(NULL);
 
-    LOG_INFO("Reset to default configuration");
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Reset to default configuration");
     pthread_mutex_unlock(&g_config_manager.config_mutex);
-    return SW_OK;
+    return STATUS_SUCCESS;
 }
 
 /**
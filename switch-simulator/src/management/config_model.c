@@ -0,0 +1,1766 @@
+/**
+ * @file config_model.c
+ * @brief Configuration model, JSON parsing and incremental apply
+ *
+ * The JSON text is parsed as a stream of tokens that fill the model as
+ * they arrive; no tree and no copy of the text is kept, so a file can be
+ * read in chunks and the memory used is the model itself. Two sorted
+ * models are compared with a single merge walk, so an apply costs time in
+ * proportion to the size of the configuration and the changes made, not
+ * to the size of the tables.
+ */
+
+#include "management/config_model.h"
+#include "common/bitmap.h"
+#include "common/logging.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Defines */
+#define CONFIG_STREAM_TOKEN_LEN     256         /* Longest string or number */
+#define CONFIG_READ_CHUNK           (64 * 1024) /* Bytes read from a file at a time */
+#define CONFIG_CACHE_MAGIC          0x46435753  /* "SWCF" */
+#define CONFIG_CACHE_VERSION        1
+
+/* Private data types */
+
+/* What the innermost open object or array holds */
+typedef enum {
+    CONFIG_CTX_ROOT,
+    CONFIG_CTX_SWITCH,
+    CONFIG_CTX_PORTS,
+    CONFIG_CTX_ENABLED,
+    CONFIG_CTX_VLANS,
+    CONFIG_CTX_VLAN,
+    CONFIG_CTX_VLAN_PORTS,
+    CONFIG_CTX_VLAN_TAGGED,
+    CONFIG_CTX_ROUTES,
+    CONFIG_CTX_ROUTE,
+    CONFIG_CTX_IGNORE               /* Unknown member, skipped */
+} config_ctx_t;
+
+/* What the grammar accepts next */
+typedef enum {
+    CONFIG_EXPECT_VALUE,
+    CONFIG_EXPECT_VALUE_OR_END,     /* After '[' */
+    CONFIG_EXPECT_KEY,              /* After ',' in an object */
+    CONFIG_EXPECT_KEY_OR_END,       /* After '{' */
+    CONFIG_EXPECT_COLON,
+    CONFIG_EXPECT_COMMA_OR_END,
+    CONFIG_EXPECT_NOTHING           /* The top value is complete */
+} config_expect_t;
+
+/* Token being read */
+typedef enum {
+    CONFIG_LEX_NONE,
+    CONFIG_LEX_STRING,
+    CONFIG_LEX_ESCAPE,
+    CONFIG_LEX_UNICODE,
+    CONFIG_LEX_NUMBER,
+    CONFIG_LEX_LITERAL
+} config_lex_t;
+
+typedef enum {
+    CONFIG_TOKEN_STRING,
+    CONFIG_TOKEN_NUMBER,
+    CONFIG_TOKEN_OTHER              /* true, false, null */
+} config_token_t;
+
+/* Open object or array */
+typedef struct {
+    bool object;
+    config_ctx_t ctx;
+} config_frame_t;
+
+/* Streaming parser */
+struct config_stream {
+    config_model_t model;
+    uint32_t vlan_capacity;
+    uint32_t route_capacity;
+    config_frame_t frames[CONFIG_MODEL_MAX_DEPTH];
+    uint32_t depth;
+    config_expect_t expect;
+    config_lex_t lex;
+    bool token_is_key;
+    char token[CONFIG_STREAM_TOKEN_LEN];
+    uint32_t token_len;
+    uint32_t unicode;
+    uint32_t unicode_digits;
+    char key[CONFIG_STREAM_TOKEN_LEN];  /* Member name of the value being read */
+    bool seen_switch;
+    config_vlan_t vlan;                 /* VLAN being read */
+    struct {
+        char prefix[CONFIG_STREAM_TOKEN_LEN];
+        char next_hop[CONFIG_STREAM_TOKEN_LEN];
+        uint32_t interface;
+        uint32_t metric;
+    } route;                            /* Route being read */
+    uint64_t offset;                    /* Bytes fed, for messages */
+    status_t status;                    /* First error */
+};
+
+/* Header of a compiled configuration; VLAN and route arrays follow */
+typedef struct {
+    uint32_t magic;                 /* CONFIG_CACHE_MAGIC */
+    uint16_t version;               /* CONFIG_CACHE_VERSION */
+    uint16_t header_size;           /* sizeof(config_cache_header_t) */
+    uint16_t vlan_record_size;      /* sizeof(config_vlan_t) */
+    uint16_t route_record_size;     /* sizeof(routing_route_t) */
+    uint32_t reserved;
+    uint32_t vlan_count;
+    uint32_t route_count;
+    uint64_t source_size;           /* Of the JSON file compiled */
+    uint64_t source_mtime_ns;
+    uint64_t source_inode;
+    char name[CONFIG_MODEL_NAME_LEN];
+    vlan_port_bitmap_t enabled_ports;
+} config_cache_header_t;
+
+/* Output of config_model_render() */
+typedef struct {
+    char *buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+} config_writer_t;
+
+/* Growable list of VLAN memberships */
+typedef struct {
+    vlan_member_t *items;
+    uint32_t count;
+    uint32_t capacity;
+} config_member_list_t;
+
+/* Forward declarations of private functions */
+static status_t config_parse_prefix(const char *text, ip_addr_t *prefix, uint8_t *prefix_len);
+static status_t config_make_route(const char *prefix, const char *next_hop, uint32_t interface,
+                                  uint32_t metric, routing_route_t *route);
+static status_t config_sort_model(config_model_t *model);
+static status_t config_sort_routes(config_model_t *model);
+static int config_route_cmp(const void *a, const void *b);
+static int config_prefix_cmp(const routing_route_t *a, const routing_route_t *b);
+
+/* Address bytes of either family, in network order */
+static inline const uint8_t *config_addr_bytes(const ip_addr_t *addr, ip_addr_type_t type) {
+    return type == IP_TYPE_V4 ? (const uint8_t *)&addr->addr.v4 : addr->addr.v6.addr;
+}
+
+static inline size_t config_addr_len(ip_addr_type_t type) {
+    return type == IP_TYPE_V4 ? 4 : 16;
+}
+
+static uint64_t config_now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/* --- Model ---------------------------------------------------------------- */
+
+/**
+ * @brief Make a model empty
+ *
+ * @param model Model
+ */
+void config_model_init(config_model_t *model) {
+    if (model) {
+        memset(model, 0, sizeof(*model));
+    }
+}
+
+/**
+ * @brief Free the arrays of a model and make it empty
+ *
+ * @param model Model, may be NULL
+ */
+void config_model_free(config_model_t *model) {
+    if (!model) {
+        return;
+    }
+    free(model->vlans);
+    free(model->routes);
+    config_model_init(model);
+}
+
+/**
+ * @brief Copy a model
+ *
+ * @param[out] dst Copy, to be freed with config_model_free()
+ * @param src Model
+ * @return STATUS_SUCCESS, STATUS_NO_MEMORY
+ */
+status_t config_model_copy(config_model_t *dst, const config_model_t *src) {
+    config_model_t copy;
+
+    if (!dst || !src) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    copy = *src;
+    copy.vlans = NULL;
+    copy.routes = NULL;
+    if (src->vlan_count > 0) {
+        copy.vlans = (config_vlan_t *)malloc(src->vlan_count * sizeof(config_vlan_t));
+        if (!copy.vlans) {
+            return STATUS_NO_MEMORY;
+        }
+        memcpy(copy.vlans, src->vlans, src->vlan_count * sizeof(config_vlan_t));
+    }
+    if (src->route_count > 0) {
+        copy.routes = (routing_route_t *)malloc(src->route_count * sizeof(routing_route_t));
+        if (!copy.routes) {
+            free(copy.vlans);
+            return STATUS_NO_MEMORY;
+        }
+        memcpy(copy.routes, src->routes, src->route_count * sizeof(routing_route_t));
+    }
+
+    *dst = copy;
+    return STATUS_SUCCESS;
+}
+
+static int config_vlan_cmp(const void *a, const void *b) {
+    const config_vlan_t *x = (const config_vlan_t *)a;
+    const config_vlan_t *y = (const config_vlan_t *)b;
+
+    return (int)x->vlan_id - (int)y->vlan_id;
+}
+
+/* Tagged wins over untagged for a port listed as both */
+static void config_vlan_normalize(config_vlan_t *vlan) {
+    bitmap_andnot(vlan->untagged.w, vlan->untagged.w, vlan->tagged.w, VLAN_PORT_WORDS);
+}
+
+/**
+ * @brief Parse "address/length" and clear the host bits
+ */
+static status_t config_parse_prefix(const char *text, ip_addr_t *prefix, uint8_t *prefix_len) {
+    char address[INET6_ADDRSTRLEN];
+    const char *slash = strchr(text, '/');
+    char *end;
+
+    if (!slash || (size_t)(slash - text) >= sizeof(address)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    memcpy(address, text, (size_t)(slash - text));
+    address[slash - text] = '\0';
+
+    memset(prefix, 0, sizeof(*prefix));
+    if (inet_pton(AF_INET, address, &prefix->addr.v4) == 1) {
+        prefix->type = IP_TYPE_V4;
+    } else if (inet_pton(AF_INET6, address, prefix->addr.v6.addr) == 1) {
+        prefix->type = IP_TYPE_V6;
+    } else {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    unsigned long len = strtoul(slash + 1, &end, 10);
+    if (slash[1] == '\0' || *end != '\0' || len > config_addr_len(prefix->type) * 8) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    *prefix_len = (uint8_t)len;
+
+    uint8_t *bytes = (uint8_t *)config_addr_bytes(prefix, prefix->type);
+    for (size_t i = 0; i < config_addr_len(prefix->type); i++) {
+        if (i * 8 >= len) {
+            bytes[i] = 0;
+        } else if (i * 8 + 8 > len) {
+            bytes[i] &= (uint8_t)(0xFF << (8 - (len - i * 8)));
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Fill a static path from its prefix, next hop, interface and metric
+ */
+static status_t config_make_route(const char *prefix, const char *next_hop, uint32_t interface,
+                                  uint32_t metric, routing_route_t *route) {
+    memset(route, 0, sizeof(*route));
+    if (config_parse_prefix(prefix, &route->prefix, &route->prefix_len) != STATUS_SUCCESS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    route->type = route->prefix.type;
+    route->next_hop.type = route->type;
+    if (next_hop && *next_hop &&
+        inet_pton(route->type == IP_TYPE_V4 ? AF_INET : AF_INET6, next_hop,
+                  (void *)config_addr_bytes(&route->next_hop, route->type)) != 1) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    route->interface_index = (uint16_t)interface;
+    route->metric = (uint16_t)metric;
+    route->source = ROUTE_TYPE_STATIC;
+    return STATUS_SUCCESS;
+}
+
+/* Order of prefixes */
+static int config_prefix_cmp(const routing_route_t *a, const routing_route_t *b) {
+    if (a->type != b->type) {
+        return a->type < b->type ? -1 : 1;
+    }
+    int diff = memcmp(config_addr_bytes(&a->prefix, a->type), config_addr_bytes(&b->prefix, b->type),
+                      config_addr_len(a->type));
+    if (diff != 0) {
+        return diff;
+    }
+    return (int)a->prefix_len - (int)b->prefix_len;
+}
+
+/* Order of paths: by prefix, then next hop and interface, which identify a path */
+static int config_route_cmp(const void *a, const void *b) {
+    const routing_route_t *x = (const routing_route_t *)a;
+    const routing_route_t *y = (const routing_route_t *)b;
+    int diff = config_prefix_cmp(x, y);
+
+    if (diff != 0) {
+        return diff;
+    }
+    diff = memcmp(config_addr_bytes(&x->next_hop, x->type), config_addr_bytes(&y->next_hop, y->type),
+                  config_addr_len(x->type));
+    if (diff != 0) {
+        return diff;
+    }
+    return (int)x->interface_index - (int)y->interface_index;
+}
+
+static status_t config_sort_routes(config_model_t *model) {
+    if (model->route_count > 1) {
+        qsort(model->routes, model->route_count, sizeof(routing_route_t), config_route_cmp);
+    }
+    for (uint32_t i = 1; i < model->route_count; i++) {
+        if (config_route_cmp(&model->routes[i], &model->routes[i - 1]) == 0) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Config: route path listed twice");
+            return STATUS_INVALID_PARAMETER;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+/* Order a model read in file order; STATUS_INVALID_PARAMETER for duplicates */
+static status_t config_sort_model(config_model_t *model) {
+    if (model->vlan_count > 1) {
+        qsort(model->vlans, model->vlan_count, sizeof(config_vlan_t), config_vlan_cmp);
+    }
+    for (uint32_t i = 1; i < model->vlan_count; i++) {
+        if (model->vlans[i].vlan_id == model->vlans[i - 1].vlan_id) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Config: VLAN %u listed twice", model->vlans[i].vlan_id);
+            return STATUS_INVALID_PARAMETER;
+        }
+    }
+    return config_sort_routes(model);
+}
+
+/* --- Streaming parser ----------------------------------------------------- */
+
+static void config_stream_fail(config_stream_t *stream, const char *what) {
+    if (stream->status == STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Config: %s at offset %llu", what, (unsigned long long)stream->offset);
+        stream->status = STATUS_INVALID_PARAMETER;
+    }
+}
+
+/**
+ * @brief Start parsing a configuration
+ *
+ * @return Parser, NULL if out of memory
+ */
+config_stream_t *config_stream_create(void) {
+    config_stream_t *stream = (config_stream_t *)calloc(1, sizeof(config_stream_t));
+
+    if (stream) {
+        config_model_init(&stream->model);
+        stream->expect = CONFIG_EXPECT_VALUE;
+        stream->status = STATUS_SUCCESS;
+    }
+    return stream;
+}
+
+/**
+ * @brief Free a parser and everything it has read
+ *
+ * @param stream Parser, may be NULL
+ */
+void config_stream_destroy(config_stream_t *stream) {
+    if (stream) {
+        config_model_free(&stream->model);
+        free(stream);
+    }
+}
+
+/* Whole number in [0, max] */
+static bool config_token_uint(const char *text, uint32_t max, uint32_t *value) {
+    char *end;
+    double number = strtod(text, &end);
+
+    if (*end != '\0' || number < 0 || number > max || number != (double)(uint32_t)number) {
+        return false;
+    }
+    *value = (uint32_t)number;
+    return true;
+}
+
+static void config_stream_add_vlan(config_stream_t *stream) {
+    config_model_t *model = &stream->model;
+
+    if (model->vlan_count == stream->vlan_capacity) {
+        uint32_t capacity = stream->vlan_capacity ? stream->vlan_capacity * 2 : 64;
+        config_vlan_t *vlans = (config_vlan_t *)realloc(model->vlans, capacity * sizeof(config_vlan_t));
+        if (!vlans) {
+            stream->status = STATUS_NO_MEMORY;
+            return;
+        }
+        model->vlans = vlans;
+        stream->vlan_capacity = capacity;
+    }
+    config_vlan_normalize(&stream->vlan);
+    model->vlans[model->vlan_count++] = stream->vlan;
+}
+
+static void config_stream_add_route(config_stream_t *stream) {
+    config_model_t *model = &stream->model;
+
+    if (model->route_count == stream->route_capacity) {
+        uint32_t capacity = stream->route_capacity ? stream->route_capacity * 2 : 1024;
+        routing_route_t *routes = (routing_route_t *)realloc(model->routes, capacity * sizeof(routing_route_t));
+        if (!routes) {
+            stream->status = STATUS_NO_MEMORY;
+            return;
+        }
+        model->routes = routes;
+        stream->route_capacity = capacity;
+    }
+    if (!stream->route.prefix[0] ||
+        config_make_route(stream->route.prefix, stream->route.next_hop, stream->route.interface,
+                          stream->route.metric, &model->routes[model->route_count]) != STATUS_SUCCESS) {
+        config_stream_fail(stream, "bad route");
+        return;
+    }
+    model->route_count++;
+}
+
+/* What an object or array opened in ctx under key holds */
+static config_ctx_t config_stream_child(config_stream_t *stream, config_ctx_t ctx, bool object) {
+    const char *key = stream->key;
+    config_ctx_t child = CONFIG_CTX_IGNORE;
+    bool want_object = true;
+
+    switch (ctx) {
+    case CONFIG_CTX_ROOT:
+        if (strcmp(key, "switch") == 0) {
+            child = CONFIG_CTX_SWITCH;
+        }
+        break;
+    case CONFIG_CTX_SWITCH:
+        if (strcmp(key, "ports") == 0) {
+            child = CONFIG_CTX_PORTS;
+        } else if (strcmp(key, "vlans") == 0) {
+            child = CONFIG_CTX_VLANS;
+        } else if (strcmp(key, "routes") == 0) {
+            child = CONFIG_CTX_ROUTES;
+            want_object = false;
+        }
+        break;
+    case CONFIG_CTX_PORTS:
+        if (strcmp(key, "enabled") == 0) {
+            child = CONFIG_CTX_ENABLED;
+            want_object = false;
+        }
+        break;
+    case CONFIG_CTX_VLANS:
+        child = CONFIG_CTX_VLAN;
+        break;
+    case CONFIG_CTX_VLAN:
+        if (strcmp(key, "ports") == 0 || strcmp(key, "tagged") == 0) {
+            child = key[0] == 'p' ? CONFIG_CTX_VLAN_PORTS : CONFIG_CTX_VLAN_TAGGED;
+            want_object = false;
+        }
+        break;
+    case CONFIG_CTX_ROUTES:
+        child = CONFIG_CTX_ROUTE;
+        break;
+    default:
+        break;
+    }
+
+    if (child != CONFIG_CTX_IGNORE && object != want_object) {
+        config_stream_fail(stream, "object of the wrong type");
+    }
+    return child;
+}
+
+static void config_stream_open(config_stream_t *stream, bool object) {
+    config_ctx_t ctx;
+
+    if (stream->depth == CONFIG_MODEL_MAX_DEPTH) {
+        config_stream_fail(stream, "nesting too deep");
+        return;
+    }
+
+    if (stream->depth == 0) {
+        if (!object) {
+            config_stream_fail(stream, "configuration is not an object");
+        }
+        ctx = CONFIG_CTX_ROOT;
+    } else {
+        ctx = config_stream_child(stream, stream->frames[stream->depth - 1].ctx, object);
+    }
+
+    if (ctx == CONFIG_CTX_VLAN) {
+        char *end;
+        unsigned long id = strtoul(stream->key, &end, 10);
+
+        if (!stream->key[0] || *end != '\0' || id < VLAN_ID_MIN || id > VLAN_ID_MAX) {
+            config_stream_fail(stream, "bad VLAN ID");
+        }
+        memset(&stream->vlan, 0, sizeof(stream->vlan));
+        stream->vlan.vlan_id = (vlan_id_t)id;
+    } else if (ctx == CONFIG_CTX_ROUTE) {
+        memset(&stream->route, 0, sizeof(stream->route));
+    } else if (ctx == CONFIG_CTX_SWITCH) {
+        stream->seen_switch = true;
+    }
+
+    stream->frames[stream->depth].object = object;
+    stream->frames[stream->depth].ctx = ctx;
+    stream->depth++;
+    stream->expect = object ? CONFIG_EXPECT_KEY_OR_END : CONFIG_EXPECT_VALUE_OR_END;
+}
+
+static void config_stream_close(config_stream_t *stream) {
+    config_ctx_t ctx = stream->frames[--stream->depth].ctx;
+
+    if (ctx == CONFIG_CTX_VLAN) {
+        config_stream_add_vlan(stream);
+    } else if (ctx == CONFIG_CTX_ROUTE) {
+        config_stream_add_route(stream);
+    }
+    stream->expect = stream->depth ? CONFIG_EXPECT_COMMA_OR_END : CONFIG_EXPECT_NOTHING;
+}
+
+/* A string, number or literal value in the innermost object or array */
+static void config_stream_scalar(config_stream_t *stream, config_token_t type) {
+    config_ctx_t ctx = stream->depth ? stream->frames[stream->depth - 1].ctx : CONFIG_CTX_ROOT;
+    const char *key = stream->key;
+    const char *text = stream->token;
+    uint32_t number;
+
+    stream->expect = stream->depth ? CONFIG_EXPECT_COMMA_OR_END : CONFIG_EXPECT_NOTHING;
+
+    switch (ctx) {
+    case CONFIG_CTX_ROOT:
+        if (stream->depth == 0) {
+            config_stream_fail(stream, "configuration is not an object");
+        }
+        break;
+    case CONFIG_CTX_SWITCH:
+        if (strcmp(key, "name") == 0) {
+            if (type != CONFIG_TOKEN_STRING || strlen(text) >= CONFIG_MODEL_NAME_LEN) {
+                config_stream_fail(stream, "bad switch name");
+                return;
+            }
+            strcpy(stream->model.name, text);
+        }
+        break;
+    case CONFIG_CTX_ENABLED:
+    case CONFIG_CTX_VLAN_PORTS:
+    case CONFIG_CTX_VLAN_TAGGED:
+        if (type != CONFIG_TOKEN_NUMBER || !config_token_uint(text, CONFIG_MAX_PORTS - 1, &number)) {
+            config_stream_fail(stream, "bad port in a port list");
+            return;
+        }
+        bitmap_set(ctx == CONFIG_CTX_ENABLED ? stream->model.enabled_ports.w :
+                   ctx == CONFIG_CTX_VLAN_PORTS ? stream->vlan.untagged.w : stream->vlan.tagged.w, number);
+        break;
+    case CONFIG_CTX_VLANS:
+    case CONFIG_CTX_ROUTES:
+        config_stream_fail(stream, ctx == CONFIG_CTX_VLANS ? "VLAN is not an object" : "route is not an object");
+        break;
+    case CONFIG_CTX_VLAN:
+        if (strcmp(key, "name") == 0) {
+            if (type != CONFIG_TOKEN_STRING || strlen(text) >= VLAN_NAME_MAX_LEN) {
+                config_stream_fail(stream, "bad VLAN name");
+                return;
+            }
+            strcpy(stream->vlan.name, text);
+        }
+        break;
+    case CONFIG_CTX_ROUTE:
+        if (strcmp(key, "prefix") == 0 || strcmp(key, "next_hop") == 0) {
+            if (type != CONFIG_TOKEN_STRING) {
+                config_stream_fail(stream, "bad route");
+                return;
+            }
+            strcpy(key[0] == 'p' ? stream->route.prefix : stream->route.next_hop, text);
+        } else if (strcmp(key, "interface") == 0 || strcmp(key, "metric") == 0) {
+            if (type != CONFIG_TOKEN_NUMBER || !config_token_uint(text, UINT16_MAX, &number)) {
+                config_stream_fail(stream, "bad route");
+                return;
+            }
+            *(key[0] == 'i' ? &stream->route.interface : &stream->route.metric) = number;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void config_stream_append(config_stream_t *stream, char c) {
+    if (stream->token_len + 1 >= CONFIG_STREAM_TOKEN_LEN) {
+        config_stream_fail(stream, "string or number too long");
+        return;
+    }
+    stream->token[stream->token_len++] = c;
+}
+
+/* The token just read is complete */
+static void config_stream_token(config_stream_t *stream, config_token_t type) {
+    stream->token[stream->token_len] = '\0';
+    stream->lex = CONFIG_LEX_NONE;
+
+    if (type == CONFIG_TOKEN_OTHER && strcmp(stream->token, "true") != 0 &&
+        strcmp(stream->token, "false") != 0 && strcmp(stream->token, "null") != 0) {
+        config_stream_fail(stream, "unknown literal");
+        return;
+    }
+    if (type == CONFIG_TOKEN_NUMBER) {
+        char *end;
+        (void)strtod(stream->token, &end);
+        if (*end != '\0') {
+            config_stream_fail(stream, "bad number");
+            return;
+        }
+    }
+
+    if (stream->token_is_key) {
+        memcpy(stream->key, stream->token, stream->token_len + 1);
+        stream->expect = CONFIG_EXPECT_COLON;
+    } else {
+        config_stream_scalar(stream, type);
+    }
+}
+
+/**
+ * @brief Take one character
+ *
+ * @return false if the character ended a number or literal and must be taken again
+ */
+static bool config_stream_char(config_stream_t *stream, char c) {
+    static const char escapes[] = "b\bf\fn\nr\rt\t\"\"\\\\//";
+
+    switch (stream->lex) {
+    case CONFIG_LEX_STRING:
+        if (c == '\\') {
+            stream->lex = CONFIG_LEX_ESCAPE;
+        } else if (c == '"') {
+            config_stream_token(stream, CONFIG_TOKEN_STRING);
+        } else if ((unsigned char)c < 0x20) {
+            config_stream_fail(stream, "control character in a string");
+        } else {
+            config_stream_append(stream, c);
+        }
+        return true;
+    case CONFIG_LEX_ESCAPE:
+        stream->lex = CONFIG_LEX_STRING;
+        if (c == 'u') {
+            stream->lex = CONFIG_LEX_UNICODE;
+            stream->unicode = 0;
+            stream->unicode_digits = 0;
+        } else {
+            const char *e;
+            for (e = escapes; *e && *e != c; e += 2) {
+            }
+            if (*e) {
+                config_stream_append(stream, e[1]);
+            } else {
+                config_stream_fail(stream, "bad escape");
+            }
+        }
+        return true;
+    case CONFIG_LEX_UNICODE: {
+        const char *digits = "0123456789abcdef";
+        const char *d = strchr(digits, c | 0x20);
+        if (!d || !c) {
+            config_stream_fail(stream, "bad escape");
+            return true;
+        }
+        stream->unicode = stream->unicode * 16 + (uint32_t)(d - digits);
+        if (++stream->unicode_digits == 4) {
+            // Names and addresses are ASCII; anything else is kept as a placeholder
+            config_stream_append(stream, stream->unicode < 0x80 ? (char)stream->unicode : '?');
+            stream->lex = CONFIG_LEX_STRING;
+        }
+        return true;
+    }
+    case CONFIG_LEX_NUMBER:
+        if (c && strchr("+-.0123456789eE", c)) {
+            config_stream_append(stream, c);
+            return true;
+        }
+        config_stream_token(stream, CONFIG_TOKEN_NUMBER);
+        return false;
+    case CONFIG_LEX_LITERAL:
+        if (c >= 'a' && c <= 'z') {
+            config_stream_append(stream, c);
+            return true;
+        }
+        config_stream_token(stream, CONFIG_TOKEN_OTHER);
+        return false;
+    default:
+        break;
+    }
+
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        return true;
+    }
+
+    bool in_object = stream->depth && stream->frames[stream->depth - 1].object;
+
+    switch (stream->expect) {
+    case CONFIG_EXPECT_COLON:
+        if (c == ':') {
+            stream->expect = CONFIG_EXPECT_VALUE;
+            return true;
+        }
+        break;
+    case CONFIG_EXPECT_KEY:
+    case CONFIG_EXPECT_KEY_OR_END:
+        if (c == '"') {
+            stream->lex = CONFIG_LEX_STRING;
+            stream->token_is_key = true;
+            stream->token_len = 0;
+            return true;
+        }
+        if (c == '}' && stream->expect == CONFIG_EXPECT_KEY_OR_END) {
+            config_stream_close(stream);
+            return true;
+        }
+        break;
+    case CONFIG_EXPECT_COMMA_OR_END:
+        if (c == ',') {
+            stream->expect = in_object ? CONFIG_EXPECT_KEY : CONFIG_EXPECT_VALUE;
+            return true;
+        }
+        if (c == (in_object ? '}' : ']')) {
+            config_stream_close(stream);
+            return true;
+        }
+        break;
+    case CONFIG_EXPECT_VALUE:
+    case CONFIG_EXPECT_VALUE_OR_END:
+        if (c == ']' && stream->expect == CONFIG_EXPECT_VALUE_OR_END) {
+            config_stream_close(stream);
+            return true;
+        }
+        if (!in_object) {
+            // Array elements have no member name
+            stream->key[0] = '\0';
+        }
+        if (c == '{' || c == '[') {
+            config_stream_open(stream, c == '{');
+            return true;
+        }
+        stream->token_is_key = false;
+        stream->token_len = 0;
+        if (c == '"') {
+            stream->lex = CONFIG_LEX_STRING;
+            return true;
+        }
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            stream->lex = CONFIG_LEX_NUMBER;
+            config_stream_append(stream, c);
+            return true;
+        }
+        if (c >= 'a' && c <= 'z') {
+            stream->lex = CONFIG_LEX_LITERAL;
+            config_stream_append(stream, c);
+            return true;
+        }
+        break;
+    default:
+        break;
+    }
+
+    config_stream_fail(stream, "malformed JSON");
+    return true;
+}
+
+/**
+ * @brief Parse the next piece of a configuration
+ *
+ * Pieces may split tokens anywhere.
+ *
+ * @param stream Parser
+ * @param data Text
+ * @param size Bytes of text
+ * @return STATUS_SUCCESS, or the first error; later calls return it again
+ */
+status_t config_stream_feed(config_stream_t *stream, const char *data, size_t size) {
+    size_t i = 0;
+
+    if (!stream || (!data && size > 0)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    while (i < size && stream->status == STATUS_SUCCESS) {
+        if (config_stream_char(stream, data[i])) {
+            i++;
+            stream->offset++;
+        }
+    }
+    return stream->status;
+}
+
+/**
+ * @brief Finish parsing and take the model
+ *
+ * @param stream Parser, to be destroyed by the caller
+ * @param[in,out] model Model, replaced on success and unchanged otherwise
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER for a bad configuration, STATUS_NO_MEMORY
+ */
+status_t config_stream_finish(config_stream_t *stream, config_model_t *model) {
+    if (!stream || !model) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // A number or literal may end with the text
+    if (stream->status == STATUS_SUCCESS &&
+        (stream->lex == CONFIG_LEX_NUMBER || stream->lex == CONFIG_LEX_LITERAL)) {
+        config_stream_char(stream, '\0');
+    }
+    if (stream->status == STATUS_SUCCESS && stream->expect != CONFIG_EXPECT_NOTHING) {
+        config_stream_fail(stream, "configuration ends early");
+    }
+    if (stream->status == STATUS_SUCCESS && !stream->seen_switch) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Config: no \"switch\" object");
+        stream->status = STATUS_INVALID_PARAMETER;
+    }
+    if (stream->status == STATUS_SUCCESS) {
+        stream->status = config_sort_model(&stream->model);
+    }
+    if (stream->status != STATUS_SUCCESS) {
+        return stream->status;
+    }
+
+    config_model_free(model);
+    *model = stream->model;
+    config_model_init(&stream->model);
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Parse a JSON configuration held in memory
+ *
+ * @param[in,out] model Model, replaced on success and unchanged otherwise
+ * @param json Text, need not be terminated
+ * @param size Bytes of text
+ * @return STATUS_SUCCESS, STATUS_INVALID_PARAMETER for a bad configuration, STATUS_NO_MEMORY
+ */
+status_t config_model_parse(config_model_t *model, const char *json, size_t size) {
+    config_stream_t *stream;
+    status_t status;
+
+    if (!model || !json) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    stream = config_stream_create();
+    if (!stream) {
+        return STATUS_NO_MEMORY;
+    }
+    status = config_stream_feed(stream, json, size);
+    if (status == STATUS_SUCCESS) {
+        status = config_stream_finish(stream, model);
+    }
+    config_stream_destroy(stream);
+    return status;
+}
+
+/* --- Compiled configurations ---------------------------------------------- */
+
+/* Identity of a JSON file, which a compiled copy must match */
+static void config_cache_stamp(const struct stat *st, config_cache_header_t *header) {
+    header->source_size = (uint64_t)st->st_size;
+    header->source_mtime_ns = (uint64_t)st->st_mtim.tv_sec * 1000000000ULL + (uint64_t)st->st_mtim.tv_nsec;
+    header->source_inode = (uint64_t)st->st_ino;
+}
+
+/**
+ * @brief Read a compiled configuration if it was compiled from the file as it is now
+ *
+ * @return STATUS_SUCCESS, STATUS_NOT_FOUND if missing or out of date
+ */
+static status_t config_cache_read(config_model_t *model, const char *cache_path, const struct stat *source) {
+    config_cache_header_t stamp;
+    config_model_t loaded;
+    struct stat st;
+    status_t status = STATUS_NOT_FOUND;
+
+    int fd = open(cache_path, O_RDONLY);
+    if (fd < 0) {
+        return STATUS_NOT_FOUND;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(config_cache_header_t)) {
+        close(fd);
+        return STATUS_NOT_FOUND;
+    }
+
+    size_t size = (size_t)st.st_size;
+    const uint8_t *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return STATUS_NOT_FOUND;
+    }
+
+    const config_cache_header_t *header = (const config_cache_header_t *)base;
+    config_cache_stamp(source, &stamp);
+    if (header->magic != CONFIG_CACHE_MAGIC || header->version != CONFIG_CACHE_VERSION ||
+        header->header_size != sizeof(config_cache_header_t) ||
+        header->vlan_record_size != sizeof(config_vlan_t) ||
+        header->route_record_size != sizeof(routing_route_t) ||
+        size != sizeof(config_cache_header_t) + (uint64_t)header->vlan_count * sizeof(config_vlan_t) +
+                (uint64_t)header->route_count * sizeof(routing_route_t) ||
+        header->source_size != stamp.source_size || header->source_mtime_ns != stamp.source_mtime_ns ||
+        header->source_inode != stamp.source_inode) {
+        munmap((void *)base, size);
+        return STATUS_NOT_FOUND;
+    }
+
+    config_model_init(&loaded);
+    memcpy(loaded.name, header->name, sizeof(loaded.name));
+    loaded.name[CONFIG_MODEL_NAME_LEN - 1] = '\0';
+    loaded.enabled_ports = header->enabled_ports;
+    loaded.vlans = header->vlan_count ? (config_vlan_t *)malloc(header->vlan_count * sizeof(config_vlan_t)) : NULL;
+    loaded.routes = header->route_count ?
+                    (routing_route_t *)malloc(header->route_count * sizeof(routing_route_t)) : NULL;
+    if ((header->vlan_count && !loaded.vlans) || (header->route_count && !loaded.routes)) {
+        status = STATUS_NO_MEMORY;
+    } else {
+        const uint8_t *records = base + sizeof(config_cache_header_t);
+
+        // Sorted and checked when compiled
+        memcpy(loaded.vlans, records, header->vlan_count * sizeof(config_vlan_t));
+        memcpy(loaded.routes, records + header->vlan_count * sizeof(config_vlan_t),
+               header->route_count * sizeof(routing_route_t));
+        loaded.vlan_count = header->vlan_count;
+        loaded.route_count = header->route_count;
+        status = STATUS_SUCCESS;
+    }
+    munmap((void *)base, size);
+
+    if (status != STATUS_SUCCESS) {
+        config_model_free(&loaded);
+        return status;
+    }
+    config_model_free(model);
+    *model = loaded;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Compile a model to a file, marked with the JSON file it was read from
+ *
+ * The file is replaced atomically.
+ *
+ * @param model Model
+ * @param source_path JSON file the model matches
+ * @param cache_path Compiled file
+ * @return STATUS_SUCCESS, STATUS_NOT_FOUND if the JSON file is missing, ERROR_IO_ERROR
+ */
+status_t config_model_write_cache(const config_model_t *model, const char *source_path, const char *cache_path) {
+    config_cache_header_t header;
+    char tmp_path[512];
+    struct stat st;
+    bool ok;
+
+    if (!model || !source_path || !cache_path) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (stat(source_path, &st) != 0) {
+        return STATUS_NOT_FOUND;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = CONFIG_CACHE_MAGIC;
+    header.version = CONFIG_CACHE_VERSION;
+    header.header_size = sizeof(config_cache_header_t);
+    header.vlan_record_size = sizeof(config_vlan_t);
+    header.route_record_size = sizeof(routing_route_t);
+    header.vlan_count = model->vlan_count;
+    header.route_count = model->route_count;
+    config_cache_stamp(&st, &header);
+    memcpy(header.name, model->name, sizeof(header.name));
+    header.enabled_ports = model->enabled_ports;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", cache_path);
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) {
+        return ERROR_IO_ERROR;
+    }
+    ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+         fwrite(model->vlans, sizeof(config_vlan_t), model->vlan_count, f) == model->vlan_count &&
+         fwrite(model->routes, sizeof(routing_route_t), model->route_count, f) == model->route_count &&
+         fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp_path, cache_path) != 0) {
+        unlink(tmp_path);
+        return ERROR_IO_ERROR;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Read a JSON configuration file
+ *
+ * The file is parsed in chunks. With a cache path, a compiled copy made
+ * from the file as it is now is read instead, and after parsing one is
+ * written for the next time.
+ *
+ * @param[in,out] model Model, replaced on success and unchanged otherwise
+ * @param path JSON file
+ * @param cache_path Compiled copy, NULL for none
+ * @param[out] cached Set when the compiled copy was used, may be NULL
+ * @return STATUS_SUCCESS, STATUS_NOT_FOUND if there is no file,
+ *         STATUS_INVALID_PARAMETER for a bad configuration, ERROR_IO_ERROR
+ */
+status_t config_model_load_file(config_model_t *model, const char *path, const char *cache_path, bool *cached) {
+    config_stream_t *stream;
+    struct stat st;
+    status_t status = STATUS_SUCCESS;
+    char *chunk;
+    ssize_t n;
+
+    if (!model || !path) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (cached) {
+        *cached = false;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return STATUS_NOT_FOUND;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return ERROR_IO_ERROR;
+    }
+
+    if (cache_path && config_cache_read(model, cache_path, &st) == STATUS_SUCCESS) {
+        close(fd);
+        if (cached) {
+            *cached = true;
+        }
+        return STATUS_SUCCESS;
+    }
+
+    stream = config_stream_create();
+    chunk = (char *)malloc(CONFIG_READ_CHUNK);
+    if (!stream || !chunk) {
+        close(fd);
+        config_stream_destroy(stream);
+        free(chunk);
+        return STATUS_NO_MEMORY;
+    }
+
+    while (status == STATUS_SUCCESS && (n = read(fd, chunk, CONFIG_READ_CHUNK)) != 0) {
+        if (n < 0) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Config: cannot read %s", path);
+            status = ERROR_IO_ERROR;
+            break;
+        }
+        status = config_stream_feed(stream, chunk, (size_t)n);
+    }
+    close(fd);
+    free(chunk);
+
+    if (status == STATUS_SUCCESS) {
+        status = config_stream_finish(stream, model);
+    }
+    config_stream_destroy(stream);
+
+    if (status == STATUS_SUCCESS && cache_path &&
+        config_model_write_cache(model, path, cache_path) != STATUS_SUCCESS) {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Config: cannot write compiled configuration %s", cache_path);
+    }
+    return status;
+}
+
+/* --- Rendering ------------------------------------------------------------ */
+
+static void config_write(config_writer_t *writer, const char *format, ...) {
+    va_list args;
+    int n;
+
+    if (writer->overflow) {
+        return;
+    }
+    va_start(args, format);
+    n = vsnprintf(writer->buffer + writer->length, writer->size - writer->length, format, args);
+    va_end(args);
+
+    if (n < 0 || (size_t)n >= writer->size - writer->length) {
+        writer->overflow = true;
+        return;
+    }
+    writer->length += (size_t)n;
+}
+
+static void config_write_string(config_writer_t *writer, const char *text) {
+    config_write(writer, "\"");
+    for (const unsigned char *s = (const unsigned char *)text; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            config_write(writer, "\\%c", *s);
+        } else if (*s < 0x20) {
+            config_write(writer, "\\u%04x", *s);
+        } else {
+            config_write(writer, "%c", *s);
+        }
+    }
+    config_write(writer, "\"");
+}
+
+/* Ports as "1, 2, 3", or "1,2,3" for parameters */
+static void config_write_ports(config_writer_t *writer, const vlan_port_bitmap_t *ports, const char *separator) {
+    bool first = true;
+
+    for (uint32_t port = 0; port < CONFIG_MAX_PORTS; port++) {
+        if (bitmap_test(ports->w, port)) {
+            config_write(writer, "%s%u", first ? "" : separator, port);
+            first = false;
+        }
+    }
+}
+
+static void config_write_prefix(config_writer_t *writer, const routing_route_t *route) {
+    char address[INET6_ADDRSTRLEN];
+
+    inet_ntop(route->type == IP_TYPE_V4 ? AF_INET : AF_INET6,
+              config_addr_bytes(&route->prefix, route->type), address, sizeof(address));
+    config_write(writer, "%s/%u", address, route->prefix_len);
+}
+
+static void config_write_next_hop(config_writer_t *writer, const routing_route_t *route) {
+    char address[INET6_ADDRSTRLEN];
+
+    inet_ntop(route->type == IP_TYPE_V4 ? AF_INET : AF_INET6,
+              config_addr_bytes(&route->next_hop, route->type), address, sizeof(address));
+    config_write(writer, "%s", address);
+}
+
+/**
+ * @brief Write a model as JSON
+ *
+ * @param model Model
+ * @param buffer Output
+ * @param size Bytes of buffer
+ * @param[out] length Bytes written without the terminator, may be NULL
+ * @return STATUS_SUCCESS, STATUS_RESOURCE_EXCEEDED if the buffer is too small
+ */
+status_t config_model_render(const config_model_t *model, char *buffer, size_t size, size_t *length) {
+    config_writer_t writer = { .buffer = buffer, .size = size, .length = 0, .overflow = false };
+
+    if (!model || !buffer || size == 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    config_write(&writer, "{\n  \"switch\": {\n    \"name\": ");
+    config_write_string(&writer, model->name);
+    config_write(&writer, ",\n    \"ports\": {\n      \"enabled\": [");
+    config_write_ports(&writer, &model->enabled_ports, ", ");
+    config_write(&writer, "]\n    },\n    \"vlans\": {");
+
+    for (uint32_t i = 0; i < model->vlan_count; i++) {
+        const config_vlan_t *vlan = &model->vlans[i];
+
+        config_write(&writer, "%s\n      \"%u\": {\n        \"name\": ", i ? "," : "", vlan->vlan_id);
+        config_write_string(&writer, vlan->name);
+        config_write(&writer, ",\n        \"ports\": [");
+        config_write_ports(&writer, &vlan->untagged, ", ");
+        config_write(&writer, "],\n        \"tagged\": [");
+        config_write_ports(&writer, &vlan->tagged, ", ");
+        config_write(&writer, "]\n      }");
+    }
+
+    config_write(&writer, "%s},\n    \"routes\": [", model->vlan_count ? "\n    " : "");
+    for (uint32_t i = 0; i < model->route_count; i++) {
+        const routing_route_t *route = &model->routes[i];
+
+        config_write(&writer, "%s\n      { \"prefix\": \"", i ? "," : "");
+        config_write_prefix(&writer, route);
+        config_write(&writer, "\", \"next_hop\": \"");
+        config_write_next_hop(&writer, route);
+        config_write(&writer, "\", \"interface\": %u, \"metric\": %u }", route->interface_index, route->metric);
+    }
+    config_write(&writer, "%s]\n  }\n}\n", model->route_count ? "\n    " : "");
+
+    if (writer.overflow) {
+        return STATUS_RESOURCE_EXCEEDED;
+    }
+    if (length) {
+        *length = writer.length;
+    }
+    return STATUS_SUCCESS;
+}
+
+/* --- Parameters ----------------------------------------------------------- */
+
+/* Port list "1,2,3", empty for none */
+static status_t config_parse_port_list(const char *text, vlan_port_bitmap_t *ports) {
+    memset(ports, 0, sizeof(*ports));
+
+    while (*text) {
+        char *end;
+        unsigned long port = strtoul(text, &end, 10);
+
+        if (end == text || port >= CONFIG_MAX_PORTS || (*end != ',' && *end != '\0')) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        bitmap_set(ports->w, (uint32_t)port);
+        text = *end ? end + 1 : end;
+    }
+    return STATUS_SUCCESS;
+}
+
+/* VLAN of an ID, created in sorted position when asked for */
+static config_vlan_t *config_find_vlan(config_model_t *model, vlan_id_t vlan_id, bool create) {
+    uint32_t pos = 0;
+
+    while (pos < model->vlan_count && model->vlans[pos].vlan_id < vlan_id) {
+        pos++;
+    }
+    if (pos < model->vlan_count && model->vlans[pos].vlan_id == vlan_id) {
+        return &model->vlans[pos];
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    config_vlan_t *vlans = (config_vlan_t *)realloc(model->vlans, (model->vlan_count + 1) * sizeof(config_vlan_t));
+    if (!vlans) {
+        return NULL;
+    }
+    memmove(&vlans[pos + 1], &vlans[pos], (model->vlan_count - pos) * sizeof(config_vlan_t));
+    memset(&vlans[pos], 0, sizeof(config_vlan_t));
+    vlans[pos].vlan_id = vlan_id;
+    model->vlans = vlans;
+    model->vlan_count++;
+    return &vlans[pos];
+}
+
+/* Replace the paths of one prefix with those of a "next_hop[,interface[,metric]];..." list */
+static status_t config_set_routes(config_model_t *model, const char *prefix, const char *value) {
+    routing_route_t key;
+    uint32_t paths = 1;
+    uint32_t kept = 0;
+    status_t status;
+
+    if (config_make_route(prefix, NULL, 0, 0, &key) != STATUS_SUCCESS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    for (const char *s = value; *s; s++) {
+        paths += *s == ';';
+    }
+
+    routing_route_t *routes = (routing_route_t *)malloc((model->route_count + paths) * sizeof(routing_route_t));
+    if (!routes) {
+        return STATUS_NO_MEMORY;
+    }
+    for (uint32_t i = 0; i < model->route_count; i++) {
+        if (config_prefix_cmp(&model->routes[i], &key) != 0) {
+            routes[kept++] = model->routes[i];
+        }
+    }
+
+    char *list = strdup(value);
+    if (!list) {
+        free(routes);
+        return STATUS_NO_MEMORY;
+    }
+
+    status = STATUS_SUCCESS;
+    char *save = NULL;
+    for (char *path = strtok_r(list, ";", &save); path && status == STATUS_SUCCESS;
+         path = strtok_r(NULL, ";", &save)) {
+        char next_hop[INET6_ADDRSTRLEN] = "";
+        unsigned int interface = 0;
+        unsigned int metric = 0;
+
+        if (sscanf(path, " %45[^,],%u,%u", next_hop, &interface, &metric) < 1 ||
+            interface > UINT16_MAX || metric > UINT16_MAX ||
+            config_make_route(prefix, next_hop, interface, metric, &routes[kept]) != STATUS_SUCCESS) {
+            status = STATUS_INVALID_PARAMETER;
+        } else {
+            kept++;
+        }
+    }
+    free(list);
+
+    if (status != STATUS_SUCCESS) {
+        free(routes);
+        return status;
+    }
+
+    config_model_t updated = *model;
+    updated.routes = routes;
+    updated.route_count = kept;
+    status = config_sort_routes(&updated);
+    if (status != STATUS_SUCCESS) {
+        free(routes);
+        return status;
+    }
+    free(model->routes);
+    model->routes = routes;
+    model->route_count = kept;
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Change one parameter of a model
+ *
+ * @param model Model
+ * @param key Parameter, see config_model.h
+ * @param value New value
+ * @return STATUS_SUCCESS, STATUS_NOT_FOUND for an unknown key,
+ *         STATUS_INVALID_PARAMETER for a bad value, STATUS_NO_MEMORY
+ */
+status_t config_model_set(config_model_t *model, const char *key, const char *value) {
+    if (!model || !key || !value) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (strcmp(key, "switch.name") == 0) {
+        if (strlen(value) >= CONFIG_MODEL_NAME_LEN) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        strcpy(model->name, value);
+        return STATUS_SUCCESS;
+    }
+    if (strcmp(key, "switch.ports.enabled") == 0) {
+        vlan_port_bitmap_t ports;
+        if (config_parse_port_list(value, &ports) != STATUS_SUCCESS) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        model->enabled_ports = ports;
+        return STATUS_SUCCESS;
+    }
+    if (strncmp(key, "switch.routes.", 14) == 0) {
+        return config_set_routes(model, key + 14, value);
+    }
+    if (strncmp(key, "switch.vlans.", 13) != 0) {
+        return STATUS_NOT_FOUND;
+    }
+
+    char *field;
+    unsigned long id = strtoul(key + 13, &field, 10);
+    if (field == key + 13 || id < VLAN_ID_MIN || id > VLAN_ID_MAX || (*field != '\0' && *field != '.')) {
+        return STATUS_NOT_FOUND;
+    }
+
+    if (*field == '\0' && *value == '\0') {
+        config_vlan_t *vlan = config_find_vlan(model, (vlan_id_t)id, false);
+        if (vlan) {
+            uint32_t pos = (uint32_t)(vlan - model->vlans);
+            memmove(vlan, vlan + 1, (model->vlan_count - pos - 1) * sizeof(config_vlan_t));
+            model->vlan_count--;
+        }
+        return STATUS_SUCCESS;
+    }
+
+    const char *name = *field ? field + 1 : "name";
+    vlan_port_bitmap_t ports;
+
+    if (strcmp(name, "name") == 0) {
+        if (strlen(value) >= VLAN_NAME_MAX_LEN) {
+            return STATUS_INVALID_PARAMETER;
+        }
+    } else if (strcmp(name, "ports") == 0 || strcmp(name, "tagged") == 0) {
+        if (config_parse_port_list(value, &ports) != STATUS_SUCCESS) {
+            return STATUS_INVALID_PARAMETER;
+        }
+    } else {
+        return STATUS_NOT_FOUND;
+    }
+
+    config_vlan_t *vlan = config_find_vlan(model, (vlan_id_t)id, true);
+    if (!vlan) {
+        return STATUS_NO_MEMORY;
+    }
+    if (strcmp(name, "name") == 0) {
+        strcpy(vlan->name, value);
+    } else if (strcmp(name, "ports") == 0) {
+        // Ports set untagged stop being tagged
+        vlan->untagged = ports;
+        bitmap_andnot(vlan->tagged.w, vlan->tagged.w, ports.w, VLAN_PORT_WORDS);
+    } else {
+        vlan->tagged = ports;
+        config_vlan_normalize(vlan);
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Read one parameter of a model
+ *
+ * @param model Model
+ * @param key Parameter, see config_model.h
+ * @param[out] value Value
+ * @param size Bytes of value
+ * @return STATUS_SUCCESS, STATUS_NOT_FOUND for an unknown key or object,
+ *         STATUS_RESOURCE_EXCEEDED if value is too small
+ */
+status_t config_model_get(const config_model_t *model, const char *key, char *value, size_t size) {
+    config_writer_t writer = { .buffer = value, .size = size, .length = 0, .overflow = false };
+
+    if (!model || !key || !value || size == 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    value[0] = '\0';
+
+    if (strcmp(key, "switch.name") == 0) {
+        config_write(&writer, "%s", model->name);
+    } else if (strcmp(key, "switch.ports.enabled") == 0) {
+        config_write_ports(&writer, &model->enabled_ports, ",");
+    } else if (strncmp(key, "switch.routes.", 14) == 0) {
+        routing_route_t prefix;
+        bool found = false;
+
+        if (config_make_route(key + 14, NULL, 0, 0, &prefix) != STATUS_SUCCESS) {
+            return STATUS_NOT_FOUND;
+        }
+        for (uint32_t i = 0; i < model->route_count; i++) {
+            if (config_prefix_cmp(&model->routes[i], &prefix) == 0) {
+                config_write(&writer, "%s", found ? ";" : "");
+                config_write_next_hop(&writer, &model->routes[i]);
+                config_write(&writer, ",%u,%u", model->routes[i].interface_index, model->routes[i].metric);
+                found = true;
+            }
+        }
+        if (!found) {
+            return STATUS_NOT_FOUND;
+        }
+    } else if (strncmp(key, "switch.vlans.", 13) == 0) {
+        char *field;
+        unsigned long id = strtoul(key + 13, &field, 10);
+        const config_vlan_t *vlan = NULL;
+
+        if (field != key + 13 && id >= VLAN_ID_MIN && id <= VLAN_ID_MAX) {
+            vlan = config_find_vlan((config_model_t *)model, (vlan_id_t)id, false);
+        }
+        if (!vlan) {
+            return STATUS_NOT_FOUND;
+        }
+        if (*field == '\0' || strcmp(field, ".name") == 0) {
+            config_write(&writer, "%s", vlan->name);
+        } else if (strcmp(field, ".ports") == 0) {
+            config_write_ports(&writer, &vlan->untagged, ",");
+        } else if (strcmp(field, ".tagged") == 0) {
+            config_write_ports(&writer, &vlan->tagged, ",");
+        } else {
+            return STATUS_NOT_FOUND;
+        }
+    } else {
+        return STATUS_NOT_FOUND;
+    }
+
+    return writer.overflow ? STATUS_RESOURCE_EXCEEDED : STATUS_SUCCESS;
+}
+
+/* --- Apply ---------------------------------------------------------------- */
+
+static status_t config_member_push(config_member_list_t *list, vlan_id_t vlan_id, uint32_t port,
+                                   vlan_member_type_t member_type) {
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 64;
+        vlan_member_t *items = (vlan_member_t *)realloc(list->items, capacity * sizeof(vlan_member_t));
+        if (!items) {
+            return STATUS_NO_MEMORY;
+        }
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count].vlan_id = vlan_id;
+    list->items[list->count].port_id = (port_id_t)port;
+    list->items[list->count].member_type = member_type;
+    list->count++;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Queue the membership changes of one VLAN; old is NULL for a new VLAN.
+ * A port whose tagging changes is only added again, which retags it.
+ */
+static status_t config_diff_members(const config_vlan_t *old, const config_vlan_t *new_vlan,
+                                    config_member_list_t *removals, config_member_list_t *additions) {
+    static const config_vlan_t none;
+    status_t status = STATUS_SUCCESS;
+
+    if (!old) {
+        old = &none;
+    }
+    for (uint32_t port = 0; port < CONFIG_MAX_PORTS && status == STATUS_SUCCESS; port++) {
+        bool was_tagged = bitmap_test(old->tagged.w, port);
+        bool was_member = was_tagged || bitmap_test(old->untagged.w, port);
+        bool tagged = bitmap_test(new_vlan->tagged.w, port);
+        bool member = tagged || bitmap_test(new_vlan->untagged.w, port);
+
+        if (was_member && !member) {
+            status = config_member_push(removals, new_vlan->vlan_id, port, VLAN_MEMBER_UNTAGGED);
+        } else if (member && (!was_member || tagged != was_tagged)) {
+            status = config_member_push(additions, new_vlan->vlan_id, port,
+                                        tagged ? VLAN_MEMBER_TAGGED : VLAN_MEMBER_UNTAGGED);
+        }
+    }
+    return status;
+}
+
+/* Count the outcome of one change; what already is as wanted counts as done */
+static void config_count(config_diff_stats_t *stats, status_t status, status_t done_too,
+                         uint32_t *counter, status_t *result) {
+    if (status == STATUS_SUCCESS || status == done_too) {
+        (*counter)++;
+    } else {
+        stats->failed++;
+        *result = status;
+    }
+}
+
+/* Paths equal in everything that is programmed */
+static bool config_same_paths(const routing_route_t *a, uint32_t a_count, const routing_route_t *b, uint32_t b_count) {
+    if (a_count != b_count) {
+        return false;
+    }
+    for (uint32_t i = 0; i < a_count; i++) {
+        if (config_route_cmp(&a[i], &b[i]) != 0 || a[i].metric != b[i].metric) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Compare the routes of both models prefix by prefix. A prefix that went
+ * away is removed; a prefix whose paths changed is removed and added
+ * again in the same batch, so the FIB only sees the new paths.
+ */
+static status_t config_diff_routes(const config_model_t *running, const config_model_t *target,
+                                   routing_route_t **removals, uint32_t **removal_paths, uint32_t *removal_count,
+                                   routing_route_t **additions, uint32_t *addition_count) {
+    uint32_t i = 0, j = 0;
+
+    *removal_count = 0;
+    *addition_count = 0;
+    *removals = (routing_route_t *)malloc((running->route_count + 1) * sizeof(routing_route_t));
+    *removal_paths = (uint32_t *)malloc((running->route_count + 1) * sizeof(uint32_t));
+    *additions = (routing_route_t *)malloc((target->route_count + 1) * sizeof(routing_route_t));
+    if (!*removals || !*removal_paths || !*additions) {
+        free(*removals);
+        free(*removal_paths);
+        free(*additions);
+        *removals = *additions = NULL;
+        *removal_paths = NULL;
+        return STATUS_NO_MEMORY;
+    }
+
+    while (i < running->route_count || j < target->route_count) {
+        uint32_t i_end = i, j_end = j;
+        int order;
+
+        if (i == running->route_count) {
+            order = 1;
+        } else if (j == target->route_count) {
+            order = -1;
+        } else {
+            order = config_prefix_cmp(&running->routes[i], &target->routes[j]);
+        }
+        while (order <= 0 && i_end < running->route_count &&
+               config_prefix_cmp(&running->routes[i_end], &running->routes[i]) == 0) {
+            i_end++;
+        }
+        while (order >= 0 && j_end < target->route_count &&
+               config_prefix_cmp(&target->routes[j_end], &target->routes[j]) == 0) {
+            j_end++;
+        }
+
+        if (order != 0 || !config_same_paths(&running->routes[i], i_end - i, &target->routes[j], j_end - j)) {
+            if (i_end > i) {
+                (*removal_paths)[*removal_count] = i_end - i;
+                (*removals)[(*removal_count)++] = running->routes[i];
+            }
+            for (uint32_t k = j; k < j_end; k++) {
+                (*additions)[(*addition_count)++] = target->routes[k];
+            }
+        }
+        i = i_end;
+        j = j_end;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Apply the difference between two models to the switch
+ *
+ * @param running Model the switch is in
+ * @param target Model it should be in
+ * @param[out] stats Changes made, may be NULL
+ * @return STATUS_SUCCESS, or the error of the last change that failed
+ */
+status_t config_model_apply(const config_model_t *running, const config_model_t *target,
+                            config_diff_stats_t *stats) {
+    config_diff_stats_t own_stats;
+    config_member_list_t member_removals = {0}, member_additions = {0};
+    routing_route_t *route_removals = NULL, *route_additions = NULL;
+    uint32_t *removal_paths = NULL;
+    uint32_t route_removal_count = 0, route_addition_count = 0;
+    status_t *statuses = NULL;
+    status_t result = STATUS_SUCCESS;
+    status_t status;
+    uint64_t start_us = config_now_us();
+    uint32_t i, j;
+
+    if (!running || !target) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (!stats) {
+        stats = &own_stats;
+    }
+    memset(stats, 0, sizeof(*stats));
+
+    // Work out every change before making any
+    status = config_diff_routes(running, target, &route_removals, &removal_paths, &route_removal_count,
+                                &route_additions, &route_addition_count);
+    for (i = 0, j = 0; status == STATUS_SUCCESS && j < target->vlan_count; j++) {
+        while (i < running->vlan_count && running->vlans[i].vlan_id < target->vlans[j].vlan_id) {
+            i++;
+        }
+        const config_vlan_t *old = (i < running->vlan_count && running->vlans[i].vlan_id == target->vlans[j].vlan_id) ?
+                                   &running->vlans[i] : NULL;
+        status = config_diff_members(old, &target->vlans[j], &member_removals, &member_additions);
+    }
+    uint32_t most = route_removal_count > route_addition_count ? route_removal_count : route_addition_count;
+    most = most > member_removals.count ? most : member_removals.count;
+    most = most > member_additions.count ? most : member_additions.count;
+    if (status == STATUS_SUCCESS && most > 0) {
+        statuses = (status_t *)malloc(most * sizeof(status_t));
+        if (!statuses) {
+            status = STATUS_NO_MEMORY;
+        }
+    }
+    if (status != STATUS_SUCCESS) {
+        free(route_removals);
+        free(removal_paths);
+        free(route_additions);
+        free(member_removals.items);
+        free(member_additions.items);
+        return status;
+    }
+
+    // Routes change in one batch, committed once L2 is in place
+    bool batch = (route_removal_count > 0 || route_addition_count > 0) &&
+                 routing_table_begin_batch() == STATUS_SUCCESS;
+
+    // Removals, last dependency first: routes, members, VLANs, ports
+    if (route_removal_count > 0) {
+        routing_table_update_routes(route_removals, route_removal_count, true, false, statuses);
+        // One removal per prefix takes all its paths
+        for (i = 0; i < route_removal_count; i++) {
+            uint32_t removed = 0;
+            config_count(stats, statuses[i], STATUS_NOT_FOUND, &removed, &result);
+            stats->routes_removed += removed ? removal_paths[i] : 0;
+        }
+    }
+
+    if (member_removals.count > 0) {
+        vlan_remove_members_bulk(member_removals.items, member_removals.count, false, statuses);
+        for (i = 0; i < member_removals.count; i++) {
+            config_count(stats, statuses[i], STATUS_NOT_FOUND, &stats->members_removed, &result);
+        }
+    }
+
+    for (i = 0, j = 0; i < running->vlan_count; i++) {
+        while (j < target->vlan_count && target->vlans[j].vlan_id < running->vlans[i].vlan_id) {
+            j++;
+        }
+        if ((j == target->vlan_count || target->vlans[j].vlan_id != running->vlans[i].vlan_id) &&
+            running->vlans[i].vlan_id != VLAN_ID_DEFAULT) {
+            // The default VLAN always exists; leaving the configuration only releases its members
+            config_count(stats, vlan_delete(running->vlans[i].vlan_id), STATUS_NOT_FOUND,
+                         &stats->vlans_deleted, &result);
+        }
+    }
+
+    for (uint32_t port = 0; port < CONFIG_MAX_PORTS; port++) {
+        if (bitmap_test(running->enabled_ports.w, port) && !bitmap_test(target->enabled_ports.w, port)) {
+            config_count(stats, port_disable((port_id_t)port), STATUS_SUCCESS, &stats->ports_disabled, &result);
+        }
+    }
+
+    // Additions, first dependency first: ports, VLANs, members, routes
+    for (uint32_t port = 0; port < CONFIG_MAX_PORTS; port++) {
+        if (bitmap_test(target->enabled_ports.w, port) && !bitmap_test(running->enabled_ports.w, port)) {
+            config_count(stats, port_enable((port_id_t)port), STATUS_SUCCESS, &stats->ports_enabled, &result);
+        }
+    }
+
+    for (i = 0, j = 0; j < target->vlan_count; j++) {
+        const config_vlan_t *vlan = &target->vlans[j];
+
+        while (i < running->vlan_count && running->vlans[i].vlan_id < vlan->vlan_id) {
+            i++;
+        }
+        if (i < running->vlan_count && running->vlans[i].vlan_id == vlan->vlan_id) {
+            if (strcmp(running->vlans[i].name, vlan->name) != 0 && vlan->name[0]) {
+                config_count(stats, vlan_set_name(vlan->vlan_id, vlan->name), STATUS_SUCCESS,
+                             &stats->vlans_renamed, &result);
+            }
+            continue;
+        }
+
+        status = vlan_create(vlan->vlan_id, vlan->name[0] ? vlan->name : NULL);
+        if (status == STATUS_ALREADY_EXISTS && vlan->name[0]) {
+            // Such as the default VLAN: it is taken over with the configured name
+            status = vlan_set_name(vlan->vlan_id, vlan->name);
+        }
+        config_count(stats, status, STATUS_ALREADY_EXISTS, &stats->vlans_created, &result);
+    }
+
+    if (member_additions.count > 0) {
+        vlan_add_members_bulk(member_additions.items, member_additions.count, false, statuses);
+        for (i = 0; i < member_additions.count; i++) {
+            config_count(stats, statuses[i], STATUS_ALREADY_EXISTS, &stats->members_added, &result);
+        }
+    }
+
+    if (route_addition_count > 0) {
+        routing_table_update_routes(route_additions, route_addition_count, false, false, statuses);
+        for (i = 0; i < route_addition_count; i++) {
+            config_count(stats, statuses[i], STATUS_ALREADY_EXISTS, &stats->routes_added, &result);
+        }
+    }
+
+    if (batch) {
+        status = routing_table_commit_batch();
+        if (status != STATUS_SUCCESS) {
+            stats->failed++;
+            result = status;
+        }
+    }
+
+    free(statuses);
+    free(route_removals);
+    free(removal_paths);
+    free(route_additions);
+    free(member_removals.items);
+    free(member_additions.items);
+
+    stats->elapsed_us = config_now_us() - start_us;
+    return result;
+}
@@ -0,0 +1,1208 @@
+/**
+ * @file mgmt_server.c
+ * @brief HTTP/1.1 management server on its own epoll thread
+ *
+ * Connections live in a fixed table; epoll data holds the slot index plus
+ * MGMT_EV_CONN_BASE, below which are the listening socket and the eventfd
+ * that wakes the thread to stop. Descriptors are level-triggered, so the
+ * work left on a connection by the per-wakeup limits is simply found
+ * again: a connection that still holds complete requests goes on the
+ * pending list and the next epoll_wait() does not block.
+ *
+ * Every connection has one input buffer, holding the request being read
+ * and any pipelined behind it, and one output buffer, holding answers not
+ * yet written. Both grow as needed, the input up to one request of
+ * MGMT_SERVER_MAX_HEADER and CONFIG_MGMT_SERVER_MAX_BODY bytes.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "management/mgmt_server.h"
+#include "management/bulk_api.h"
+#include "management/config_manager.h"
+#include "common/logging.h"
+#include "common/mem_account.h"
+
+#define MGMT_EV_LISTEN          0
+#define MGMT_EV_WAKE            1
+#define MGMT_EV_CONN_BASE       2
+#define MGMT_MAX_EVENTS         64
+#define MGMT_INPUT_MIN          4096
+#define MGMT_TEXT_MAX           65536       /**< Text answers, CLI-style reports and JSON */
+#define MGMT_READ_RETRIES       4           /**< Table reads retried as the table grows */
+
+/**
+ * @brief Connection
+ */
+typedef struct mgmt_conn {
+    int fd;                         /**< -1 for a free slot */
+    uint32_t next;                  /**< Next free slot, or next pending connection */
+    uint8_t *in;
+    size_t in_len;
+    size_t in_cap;
+    uint8_t *out;
+    size_t out_off;                 /**< Bytes of out already written */
+    size_t out_len;
+    size_t out_cap;
+    uint64_t last_active_us;
+    uint32_t events;                /**< Events asked of epoll */
+    bool close_after;               /**< Close once out is written */
+    bool pending;                   /**< On the pending list */
+    bool continue_sent;             /**< 100 Continue sent for the request being read */
+} mgmt_conn_t;
+
+/**
+ * @brief Request being answered
+ */
+typedef struct {
+    char method[8];
+    const char *path;               /**< Target, NUL-terminated in the input buffer */
+    const uint8_t *body;
+    size_t body_len;
+} mgmt_request_t;
+
+#define MGMT_NONE UINT32_MAX
+
+static struct {
+    bool started;
+    volatile bool running;
+    int listen_fd;
+    int wake_fd;
+    int epoll_fd;
+    int cpu;
+    pthread_t thread;
+    mgmt_conn_t *conns;
+    uint32_t free_head;
+    uint32_t pending_head;
+    uint32_t pending_tail;
+    char *text;                     /**< MGMT_TEXT_MAX scratch for text answers */
+    uint8_t *scratch;               /**< Binary answers and decoded columns */
+    size_t scratch_cap;
+    uint32_t route_hint;            /**< Rows the last table reads returned */
+    uint32_t mac_hint;
+    uint32_t member_hint;
+    mgmt_server_stats_t stats;      /**< Written by the server thread only */
+} g_mgmt = { .listen_fd = -1, .wake_fd = -1, .epoll_fd = -1 };
+
+/**
+ * @brief Monotonic system time; idle clients are timed in real time even
+ *        when the simulator clock is virtual
+ */
+static uint64_t mgmt_now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static inline void mgmt_count(uint64_t *counter, uint64_t value) {
+    __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+static const char *mgmt_reason(int code) {
+    switch (code) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 409: return "Conflict";
+    case 413: return "Payload Too Large";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    case 505: return "HTTP Version Not Supported";
+    case 507: return "Insufficient Storage";
+    default:  return "Error";
+    }
+}
+
+/**
+ * @brief HTTP status of a management call's result
+ */
+static int mgmt_http_status(status_t status) {
+    // Some codes are defines outside the enumeration
+    switch ((int)status) {
+    case STATUS_SUCCESS:
+        return 200;
+    case STATUS_INVALID_PARAMETER:
+    case STATUS_OUT_OF_BOUNDS:
+        return 400;
+    case STATUS_NOT_FOUND:
+        return 404;
+    case STATUS_ALREADY_EXISTS:
+        return 409;
+    case STATUS_RESOURCE_EXHAUSTED:
+    case STATUS_TABLE_FULL:
+    case STATUS_NO_MEMORY:
+        return 507;
+    case STATUS_NOT_INITIALIZED:
+        return 503;
+    case STATUS_UNSUPPORTED_OPERATION:
+        return 501;
+    default:
+        return 500;
+    }
+}
+
+/* ---- Buffers ---- */
+
+static bool mgmt_reserve(uint8_t **buf, size_t *cap, size_t need) {
+    size_t new_cap;
+    uint8_t *grown;
+
+    if (need <= *cap) {
+        return true;
+    }
+    new_cap = *cap ? *cap : MGMT_INPUT_MIN;
+    while (new_cap < need) {
+        new_cap *= 2;
+    }
+    grown = (uint8_t *)mem_realloc(MEM_TAG_MGMT, *buf, new_cap);
+    if (!grown) {
+        return false;
+    }
+    *buf = grown;
+    *cap = new_cap;
+    return true;
+}
+
+static uint8_t *mgmt_scratch(size_t size) {
+    return mgmt_reserve(&g_mgmt.scratch, &g_mgmt.scratch_cap, size ? size : 1) ? g_mgmt.scratch : NULL;
+}
+
+static bool mgmt_out_append(mgmt_conn_t *conn, const void *data, size_t len) {
+    // Written bytes are dropped before growing
+    if (conn->out_off > 0 && conn->out_len + len > conn->out_cap) {
+        memmove(conn->out, conn->out + conn->out_off, conn->out_len - conn->out_off);
+        conn->out_len -= conn->out_off;
+        conn->out_off = 0;
+    }
+    if (!mgmt_reserve(&conn->out, &conn->out_cap, conn->out_len + len)) {
+        return false;
+    }
+    memcpy(conn->out + conn->out_len, data, len);
+    conn->out_len += len;
+    return true;
+}
+
+/**
+ * @brief Queue an answer
+ */
+static void mgmt_respond(mgmt_conn_t *conn, int code, const char *type, const void *body, size_t len) {
+    char header[256];
+    int n;
+
+    n = snprintf(header, sizeof(header), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%s\r\n",
+                 code, mgmt_reason(code), type, len, conn->close_after ? "Connection: close\r\n" : "");
+    if (!mgmt_out_append(conn, header, (size_t)n) || !mgmt_out_append(conn, body, len)) {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Management server: no memory for an answer, closing");
+        conn->close_after = true;
+        conn->in_len = 0;
+    }
+    mgmt_count(&g_mgmt.stats.requests, 1);
+    if (code >= 400) {
+        mgmt_count(&g_mgmt.stats.errors, 1);
+    }
+}
+
+static void mgmt_respond_status(mgmt_conn_t *conn, int code, status_t status) {
+    char body[64];
+    int n = snprintf(body, sizeof(body), "{\"status\": %d}\n", (int)status);
+
+    mgmt_respond(conn, code, "application/json", body, (size_t)n);
+}
+
+/* ---- Endpoints ---- */
+
+static void mgmt_get_server(mgmt_conn_t *conn) {
+    const mgmt_server_stats_t *s = &g_mgmt.stats;
+    int n = snprintf(g_mgmt.text, MGMT_TEXT_MAX,
+                     "{\"connections\": %llu, \"accepted\": %llu, \"rejected\": %llu, \"idle_closed\": %llu, "
+                     "\"requests\": %llu, \"pipelined\": %llu, \"deferred\": %llu, \"throttled\": %llu, "
+                     "\"errors\": %llu, \"bytes_in\": %llu, \"bytes_out\": %llu}\n",
+                     (unsigned long long)s->connections, (unsigned long long)s->accepted,
+                     (unsigned long long)s->rejected, (unsigned long long)s->idle_closed,
+                     (unsigned long long)s->requests, (unsigned long long)s->pipelined,
+                     (unsigned long long)s->deferred, (unsigned long long)s->throttled,
+                     (unsigned long long)s->errors, (unsigned long long)s->bytes_in,
+                     (unsigned long long)s->bytes_out);
+
+    mgmt_respond(conn, 200, "application/json", g_mgmt.text, (size_t)n);
+}
+
+static void mgmt_get_memory(mgmt_conn_t *conn) {
+    size_t len = mem_account_report(g_mgmt.text, MGMT_TEXT_MAX);
+
+    mgmt_respond(conn, 200, "text/plain", g_mgmt.text, len < MGMT_TEXT_MAX ? len : MGMT_TEXT_MAX - 1);
+}
+
+static void mgmt_config_param(mgmt_conn_t *conn, const mgmt_request_t *req, const char *key) {
+    status_t status;
+
+    if (*key == '\0') {
+        mgmt_respond_status(conn, 404, STATUS_NOT_FOUND);
+        return;
+    }
+    if (strcmp(req->method, "GET") == 0) {
+        status = config_manager_get_param(key, g_mgmt.text, MGMT_TEXT_MAX);
+        if (status == STATUS_SUCCESS) {
+            mgmt_respond(conn, 200, "text/plain", g_mgmt.text, strlen(g_mgmt.text));
+            return;
+        }
+    } else if (strcmp(req->method, "PUT") == 0) {
+        if (req->body_len >= MGMT_TEXT_MAX) {
+            mgmt_respond_status(conn, 413, STATUS_INVALID_PARAMETER);
+            return;
+        }
+        memcpy(g_mgmt.text, req->body, req->body_len);
+        g_mgmt.text[req->body_len] = '\0';
+        status = config_manager_set_param(key, g_mgmt.text);
+        if (status == STATUS_SUCCESS) {
+            mgmt_respond(conn, 200, "text/plain", "", 0);
+            return;
+        }
+    } else {
+        mgmt_respond_status(conn, 405, STATUS_UNSUPPORTED_OPERATION);
+        return;
+    }
+    mgmt_respond_status(conn, mgmt_http_status(status), status);
+}
+
+static void mgmt_post_config(mgmt_conn_t *conn, const mgmt_request_t *req) {
+    config_diff_stats_t diff;
+    status_t status;
+    int n;
+
+    memset(&diff, 0, sizeof(diff));
+    status = config_manager_apply_json((const char *)req->body, req->body_len, &diff);
+    n = snprintf(g_mgmt.text, MGMT_TEXT_MAX,
+                 "{\"status\": %d, \"ports_enabled\": %u, \"ports_disabled\": %u, \"vlans_created\": %u, "
+                 "\"vlans_deleted\": %u, \"vlans_renamed\": %u, \"members_added\": %u, "
+                 "\"members_removed\": %u, \"routes_added\": %u, \"routes_removed\": %u, "
+                 "\"failed\": %u, \"elapsed_us\": %llu}\n",
+                 (int)status, diff.ports_enabled, diff.ports_disabled, diff.vlans_created, diff.vlans_deleted,
+                 diff.vlans_renamed, diff.members_added, diff.members_removed, diff.routes_added,
+                 diff.routes_removed, diff.failed, (unsigned long long)diff.elapsed_us);
+    mgmt_respond(conn, mgmt_http_status(status), "application/json", g_mgmt.text, (size_t)n);
+}
+
+/**
+ * @brief Answer a batch write with the status of each row
+ */
+static void mgmt_respond_rows(mgmt_conn_t *conn, status_t result, const status_t *statuses, uint32_t count) {
+    int32_t *rows = (int32_t *)g_mgmt.text;
+
+    // Statuses were kept apart from the decoded columns; pack them as int32_t
+    if ((size_t)count * sizeof(int32_t) > MGMT_TEXT_MAX) {
+        mgmt_respond_status(conn, mgmt_http_status(result), result);
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        rows[i] = (int32_t)statuses[i];
+    }
+    mgmt_respond(conn, mgmt_http_status(result), "application/octet-stream", rows, count * sizeof(int32_t));
+}
+
+static void mgmt_routes(mgmt_conn_t *conn, const mgmt_request_t *req) {
+    bulk_route_columns_t cols;
+    status_t status;
+    uint32_t count;
+    uint8_t *mem;
+
+    if (strcmp(req->method, "GET") == 0) {
+        uint32_t capacity = g_mgmt.route_hint + 64;
+
+        for (uint32_t attempt = 0; attempt < MGMT_READ_RETRIES; attempt++) {
+            const size_t row = sizeof(mgmt_route_record_t) + 2 * BULK_ADDR_LEN + 3 + 2 * sizeof(uint16_t);
+
+            mem = mgmt_scratch((size_t)capacity * row);
+            if (!mem) {
+                mgmt_respond_status(conn, 507, STATUS_NO_MEMORY);
+                return;
+            }
+            // Records first, columns behind them
+            cols.prefix = (uint8_t (*)[BULK_ADDR_LEN])(mem + (size_t)capacity * sizeof(mgmt_route_record_t));
+            cols.next_hop = cols.prefix + capacity;
+            cols.interface = (uint16_t *)(cols.next_hop + capacity);
+            cols.metric = cols.interface + capacity;
+            cols.is_ipv6 = (uint8_t *)(cols.metric + capacity);
+            cols.prefix_len = cols.is_ipv6 + capacity;
+            cols.source = cols.prefix_len + capacity;
+            status = bulk_read_routes(&cols, capacity, &count);
+            if (status != STATUS_OUT_OF_BOUNDS) {
+                break;
+            }
+            capacity = count + count / 8 + 64;
+        }
+        if (status != STATUS_SUCCESS) {
+            mgmt_respond_status(conn, mgmt_http_status(status), status);
+            return;
+        }
+        g_mgmt.route_hint = count;
+        for (uint32_t i = 0; i < count; i++) {
+            mgmt_route_record_t *r = (mgmt_route_record_t *)mem + i;
+
+            memcpy(r->prefix, cols.prefix[i], BULK_ADDR_LEN);
+            memcpy(r->next_hop, cols.next_hop[i], BULK_ADDR_LEN);
+            r->is_ipv6 = cols.is_ipv6[i];
+            r->prefix_len = cols.prefix_len[i];
+            r->interface = cols.interface[i];
+            r->metric = cols.metric[i];
+            r->source = cols.source[i];
+            r->reserved = 0;
+        }
+        mgmt_respond(conn, 200, "application/octet-stream", mem, count * sizeof(mgmt_route_record_t));
+        return;
+    }
+
+    bool remove = strcmp(req->method, "DELETE") == 0;
+    if (!remove && strcmp(req->method, "POST") != 0) {
+        mgmt_respond_status(conn, 405, STATUS_UNSUPPORTED_OPERATION);
+        return;
+    }
+    if (req->body_len % sizeof(mgmt_route_record_t) != 0) {
+        mgmt_respond_status(conn, 400, STATUS_INVALID_PARAMETER);
+        return;
+    }
+    count = (uint32_t)(req->body_len / sizeof(mgmt_route_record_t));
+    mem = mgmt_scratch((size_t)count * (2 * BULK_ADDR_LEN + 3 + 2 * sizeof(uint16_t) + sizeof(status_t)));
+    if (!mem) {
+        mgmt_respond_status(conn, 507, STATUS_NO_MEMORY);
+        return;
+    }
+    status_t *statuses = (status_t *)mem;
+    cols.prefix = (uint8_t (*)[BULK_ADDR_LEN])(statuses + count);
+    cols.next_hop = cols.prefix + count;
+    cols.interface = (uint16_t *)(cols.next_hop + count);
+    cols.metric = cols.interface + count;
+    cols.is_ipv6 = (uint8_t *)(cols.metric + count);
+    cols.prefix_len = cols.is_ipv6 + count;
+    cols.source = cols.prefix_len + count;
+    for (uint32_t i = 0; i < count; i++) {
+        mgmt_route_record_t r;
+
+        memcpy(&r, req->body + (size_t)i * sizeof(r), sizeof(r));
+        memcpy(cols.prefix[i], r.prefix, BULK_ADDR_LEN);
+        memcpy(cols.next_hop[i], r.next_hop, BULK_ADDR_LEN);
+        cols.is_ipv6[i] = r.is_ipv6;
+        cols.prefix_len[i] = r.prefix_len;
+        cols.interface[i] = r.interface;
+        cols.metric[i] = r.metric;
+        cols.source[i] = r.source;
+    }
+    status = bulk_update_routes(&cols, count, remove, statuses);
+    mgmt_respond_rows(conn, status, statuses, count);
+}
+
+static void mgmt_macs(mgmt_conn_t *conn, const mgmt_request_t *req) {
+    bulk_mac_columns_t cols;
+    status_t status;
+    uint32_t count;
+    uint8_t *mem;
+
+    if (strcmp(req->method, "GET") == 0) {
+        uint32_t capacity = g_mgmt.mac_hint + 64;
+
+        for (uint32_t attempt = 0; attempt < MGMT_READ_RETRIES; attempt++) {
+            const size_t row = sizeof(mgmt_mac_record_t) + MAC_ADDR_LEN + 2 * sizeof(uint16_t) +
+                               sizeof(uint32_t) + 1;
+
+            mem = mgmt_scratch((size_t)capacity * row);
+            if (!mem) {
+                mgmt_respond_status(conn, 507, STATUS_NO_MEMORY);
+                return;
+            }
+            cols.age_timestamp = (uint32_t *)(mem + (size_t)capacity * sizeof(mgmt_mac_record_t));
+            cols.vlan_id = (uint16_t *)(cols.age_timestamp + capacity);
+            cols.port_id = cols.vlan_id + capacity;
+            cols.mac = (uint8_t (*)[MAC_ADDR_LEN])(cols.port_id + capacity);
+            cols.type = (uint8_t *)(cols.mac + capacity);
+            status = bulk_read_mac_entries(&cols, capacity, &count);
+            if (status != STATUS_OUT_OF_BOUNDS) {
+                break;
+            }
+            capacity = count + count / 8 + 64;
+        }
+        if (status != STATUS_SUCCESS) {
+            mgmt_respond_status(conn, mgmt_http_status(status), status);
+            return;
+        }
+        g_mgmt.mac_hint = count;
+        for (uint32_t i = 0; i < count; i++) {
+            mgmt_mac_record_t *r = (mgmt_mac_record_t *)mem + i;
+
+            memcpy(r->mac, cols.mac[i], MAC_ADDR_LEN);
+            r->vlan_id = cols.vlan_id[i];
+            r->port_id = cols.port_id[i];
+            r->type = cols.type[i];
+            r->reserved = 0;
+            r->age_timestamp = cols.age_timestamp[i];
+        }
+        mgmt_respond(conn, 200, "application/octet-stream", mem, count * sizeof(mgmt_mac_record_t));
+        return;
+    }
+
+    bool remove = strcmp(req->method, "DELETE") == 0;
+    if (!remove && strcmp(req->method, "POST") != 0) {
+        mgmt_respond_status(conn, 405, STATUS_UNSUPPORTED_OPERATION);
+        return;
+    }
+    if (req->body_len % sizeof(mgmt_mac_record_t) != 0) {
+        mgmt_respond_status(conn, 400, STATUS_INVALID_PARAMETER);
+        return;
+    }
+    count = (uint32_t)(req->body_len / sizeof(mgmt_mac_record_t));
+    mem = mgmt_scratch((size_t)count * (sizeof(status_t) + 2 * sizeof(uint16_t) + MAC_ADDR_LEN));
+    if (!mem) {
+        mgmt_respond_status(conn, 507, STATUS_NO_MEMORY);
+        return;
+    }
+    status_t *statuses = (status_t *)mem;
+    memset(&cols, 0, sizeof(cols));
+    cols.vlan_id = (uint16_t *)(statuses + count);
+    cols.port_id = cols.vlan_id + count;
+    cols.mac = (uint8_t (*)[MAC_ADDR_LEN])(cols.port_id + count);
+    for (uint32_t i = 0; i < count; i++) {
+        mgmt_mac_record_t r;
+
+        memcpy(&r, req->body + (size_t)i * sizeof(r), sizeof(r));
+        memcpy(cols.mac[i], r.mac, MAC_ADDR_LEN);
+        cols.vlan_id[i] = r.vlan_id;
+        cols.port_id[i] = r.port_id;
+    }
+    status = bulk_update_mac_entries(&cols, count, remove, statuses);
+    mgmt_respond_rows(conn, status, statuses, count);
+}
+
+static void mgmt_vlan_members(mgmt_conn_t *conn, const mgmt_request_t *req) {
+    bulk_vlan_member_columns_t cols;
+    status_t status;
+    uint32_t count;
+    uint8_t *mem;
+
+    if (strcmp(req->method, "GET") == 0) {
+        uint32_t capacity = g_mgmt.member_hint + 64;
+
+        for (uint32_t attempt = 0; attempt < MGMT_READ_RETRIES; attempt++) {
+            mem = mgmt_scratch((size_t)capacity * (sizeof(mgmt_vlan_member_record_t) + 2 * sizeof(uint16_t) + 1));
+            if (!mem) {
+                mgmt_respond_status(conn, 507, STATUS_NO_MEMORY);
+                return;
+            }
+            cols.vlan_id = (uint16_t *)(mem + (size_t)capacity * sizeof(mgmt_vlan_member_record_t));
+            cols.port_id = cols.vlan_id + capacity;
+            cols.tagged = (uint8_t *)(cols.port_id + capacity);
+            status = bulk_read_vlan_members(&cols, capacity, &count);
+            if (status != STATUS_OUT_OF_BOUNDS) {
+                break;
+            }
+            capacity = count + count / 8 + 64;
+        }
+        if (status != STATUS_SUCCESS) {
+            mgmt_respond_status(conn, mgmt_http_status(status), status);
+            return;
+        }
+        g_mgmt.member_hint = count;
+        for (uint32_t i = 0; i < count; i++) {
+            mgmt_vlan_member_record_t *r = (mgmt_vlan_member_record_t *)mem + i;
+
+            r->vlan_id = cols.vlan_id[i];
+            r->port_id = cols.port_id[i];
+            r->tagged = cols.tagged[i];
+            memset(r->reserved, 0, sizeof(r->reserved));
+        }
+        mgmt_respond(conn, 200, "application/octet-stream", mem, count * sizeof(mgmt_vlan_member_record_t));
+        return;
+    }
+
+    bool remove = strcmp(req->method, "DELETE") == 0;
+    if (!remove && strcmp(req->method, "POST") != 0) {
+        mgmt_respond_status(conn, 405, STATUS_UNSUPPORTED_OPERATION);
+        return;
+    }
+    if (req->body_len % sizeof(mgmt_vlan_member_record_t) != 0) {
+        mgmt_respond_status(conn, 400, STATUS_INVALID_PARAMETER);
+        return;
+    }
+    count = (uint32_t)(req->body_len / sizeof(mgmt_vlan_member_record_t));
+    mem = mgmt_scratch((size_t)count * (sizeof(status_t) + 2 * sizeof(uint16_t) + 1));
+    if (!mem) {
+        mgmt_respond_status(conn, 507, STATUS_NO_MEMORY);
+        return;
+    }
+    status_t *statuses = (status_t *)mem;
+    cols.vlan_id = (uint16_t *)(statuses + count);
+    cols.port_id = cols.vlan_id + count;
+    cols.tagged = (uint8_t *)(cols.port_id + count);
+    for (uint32_t i = 0; i < count; i++) {
+        mgmt_vlan_member_record_t r;
+
+        memcpy(&r, req->body + (size_t)i * sizeof(r), sizeof(r));
+        cols.vlan_id[i] = r.vlan_id;
+        cols.port_id[i] = r.port_id;
+        cols.tagged[i] = r.tagged;
+    }
+    status = bulk_update_vlan_members(&cols, count, remove, statuses);
+    mgmt_respond_rows(conn, status, statuses, count);
+}
+
+/**
+ * @brief Counter matrix of the port or VLAN IDs of the body
+ */
+static void mgmt_counters(mgmt_conn_t *conn, const mgmt_request_t *req, bool vlans) {
+    const uint32_t rows = vlans ? BULK_VLAN_COUNTER_COUNT : BULK_PORT_COUNTER_COUNT;
+    uint32_t count;
+    uint64_t *matrix;
+    uint16_t *ids;
+    status_t status;
+
+    if (strcmp(req->method, "POST") != 0) {
+        mgmt_respond_status(conn, 405, STATUS_UNSUPPORTED_OPERATION);
+        return;
+    }
+    if (req->body_len % sizeof(uint16_t) != 0) {
+        mgmt_respond_status(conn, 400, STATUS_INVALID_PARAMETER);
+        return;
+    }
+    count = (uint32_t)(req->body_len / sizeof(uint16_t));
+    matrix = (uint64_t *)mgmt_scratch((size_t)count * (rows * sizeof(uint64_t) + sizeof(uint16_t)));
+    if (!matrix) {
+        mgmt_respond_status(conn, 507, STATUS_NO_MEMORY);
+        return;
+    }
+    ids = (uint16_t *)(matrix + (size_t)rows * count);
+    memcpy(ids, req->body, req->body_len);
+    status = vlans ? bulk_read_vlan_counters(ids, count, matrix, NULL)
+                   : bulk_read_port_counters(ids, count, matrix, NULL);
+    (void)status;   // Ports that failed read as zeros
+    mgmt_respond(conn, 200, "application/octet-stream", matrix, (size_t)rows * count * sizeof(uint64_t));
+}
+
+static void mgmt_dispatch(mgmt_conn_t *conn, const mgmt_request_t *req) {
+    const char *path = req->path;
+    const char *query = strchr(path, '?');
+    size_t len = query ? (size_t)(query - path) : strlen(path);
+    bool get = strcmp(req->method, "GET") == 0;
+
+#define MGMT_PATH_IS(p) (len == sizeof(p) - 1 && memcmp(path, p, len) == 0)
+
+    if (MGMT_PATH_IS("/v1/server") && get) {
+        mgmt_get_server(conn);
+    } else if (MGMT_PATH_IS("/v1/memory") && get) {
+        mgmt_get_memory(conn);
+    } else if (MGMT_PATH_IS("/v1/config")) {
+        if (strcmp(req->method, "POST") == 0) {
+            mgmt_post_config(conn, req);
+        } else {
+            mgmt_respond_status(conn, 405, STATUS_UNSUPPORTED_OPERATION);
+        }
+    } else if (len > sizeof("/v1/config/") - 1 && memcmp(path, "/v1/config/", sizeof("/v1/config/") - 1) == 0) {
+        if (query) {
+            *(char *)query = '\0';
+        }
+        mgmt_config_param(conn, req, path + sizeof("/v1/config/") - 1);
+    } else if (MGMT_PATH_IS("/v1/routes")) {
+        mgmt_routes(conn, req);
+    } else if (MGMT_PATH_IS("/v1/macs")) {
+        mgmt_macs(conn, req);
+    } else if (MGMT_PATH_IS("/v1/vlan-members")) {
+        mgmt_vlan_members(conn, req);
+    } else if (MGMT_PATH_IS("/v1/port-counters")) {
+        mgmt_counters(conn, req, false);
+    } else if (MGMT_PATH_IS("/v1/vlan-counters")) {
+        mgmt_counters(conn, req, true);
+    } else {
+        mgmt_respond_status(conn, 404, STATUS_NOT_FOUND);
+    }
+
+#undef MGMT_PATH_IS
+}
+
+/* ---- HTTP ---- */
+
+/**
+ * @brief Value of a header, or NULL
+ *
+ * @param headers Header lines, each ending in CRLF
+ * @param end End of the headers
+ * @param name Header name
+ */
+static const char *mgmt_header(const char *headers, const char *end, const char *name, size_t *value_len) {
+    size_t name_len = strlen(name);
+
+    while (headers < end) {
+        const char *eol = memchr(headers, '\r', (size_t)(end - headers));
+
+        if (!eol) {
+            eol = end;
+        }
+        if ((size_t)(eol - headers) > name_len && headers[name_len] == ':' &&
+            strncasecmp(headers, name, name_len) == 0) {
+            const char *value = headers + name_len + 1;
+
+            while (value < eol && (*value == ' ' || *value == '\t')) {
+                value++;
+            }
+            *value_len = (size_t)(eol - value);
+            return value;
+        }
+        headers = eol + 2;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Parse and answer the request at the front of the input buffer
+ *
+ * @return Bytes the request took, 0 if it is not complete yet
+ */
+static size_t mgmt_handle_request(mgmt_conn_t *conn) {
+    char *buf = (char *)conn->in;
+    char *end = memmem(buf, conn->in_len, "\r\n\r\n", 4);
+    mgmt_request_t req;
+    size_t header_len, value_len;
+    const char *value;
+    unsigned long long body_len = 0;
+    bool http10;
+
+    if (!end) {
+        if (conn->in_len > MGMT_SERVER_MAX_HEADER) {
+            conn->close_after = true;
+            mgmt_respond_status(conn, 431, STATUS_OUT_OF_BOUNDS);
+            return conn->in_len;
+        }
+        return 0;
+    }
+    header_len = (size_t)(end - buf) + 4;
+
+    // Request line: method, target, version
+    char *line_end = memchr(buf, '\r', header_len);
+    char *sp1 = memchr(buf, ' ', (size_t)(line_end - buf));
+    char *sp2 = sp1 ? memchr(sp1 + 1, ' ', (size_t)(line_end - sp1 - 1)) : NULL;
+    if (!sp2 || (size_t)(sp1 - buf) >= sizeof(req.method) || sp1[1] != '/' ||
+        (size_t)(line_end - sp2 - 1) != 8 || memcmp(sp2 + 1, "HTTP/1.", 7) != 0) {
+        conn->close_after = true;
+        mgmt_respond_status(conn, 400, STATUS_INVALID_PARAMETER);
+        return conn->in_len;
+    }
+    http10 = sp2[8] == '0';
+    memcpy(req.method, buf, (size_t)(sp1 - buf));
+    req.method[sp1 - buf] = '\0';
+    *sp2 = '\0';
+    req.path = sp1 + 1;
+
+    const char *headers = line_end + 2;
+    const char *headers_end = end + 2;
+
+    if (mgmt_header(headers, headers_end, "Transfer-Encoding", &value_len)) {
+        conn->close_after = true;
+        mgmt_respond_status(conn, 501, STATUS_UNSUPPORTED_OPERATION);
+        return conn->in_len;
+    }
+    value = mgmt_header(headers, headers_end, "Content-Length", &value_len);
+    if (value) {
+        char *num_end;
+
+        body_len = strtoull(value, &num_end, 10);
+        if (num_end == value || num_end != value + value_len) {
+            conn->close_after = true;
+            mgmt_respond_status(conn, 400, STATUS_INVALID_PARAMETER);
+            return conn->in_len;
+        }
+    }
+    if (body_len > CONFIG_MGMT_SERVER_MAX_BODY) {
+        conn->close_after = true;
+        mgmt_respond_status(conn, 413, STATUS_OUT_OF_BOUNDS);
+        return conn->in_len;
+    }
+
+    if (conn->in_len < header_len + body_len) {
+        // Restore the line so that the request parses again once complete
+        *sp2 = ' ';
+        value = mgmt_header(headers, headers_end, "Expect", &value_len);
+        if (value && !conn->continue_sent && value_len == 12 && strncasecmp(value, "100-continue", 12) == 0) {
+            static const char cont[] = "HTTP/1.1 100 Continue\r\n\r\n";
+
+            (void)mgmt_out_append(conn, cont, sizeof(cont) - 1);
+            conn->continue_sent = true;
+        }
+        if (!mgmt_reserve(&conn->in, &conn->in_cap, header_len + body_len)) {
+            conn->close_after = true;
+            mgmt_respond_status(conn, 507, STATUS_NO_MEMORY);
+            return conn->in_len;
+        }
+        return 0;
+    }
+    conn->continue_sent = false;
+
+    value = mgmt_header(headers, headers_end, "Connection", &value_len);
+    if (value && value_len == 5 && strncasecmp(value, "close", 5) == 0) {
+        conn->close_after = true;
+    } else if (http10 && !(value && value_len == 10 && strncasecmp(value, "keep-alive", 10) == 0)) {
+        conn->close_after = true;
+    }
+
+    req.body = conn->in + header_len;
+    req.body_len = (size_t)body_len;
+    mgmt_dispatch(conn, &req);
+    return header_len + (size_t)body_len;
+}
+
+/* ---- Connections ---- */
+
+static inline uint32_t mgmt_conn_index(const mgmt_conn_t *conn) {
+    return (uint32_t)(conn - g_mgmt.conns);
+}
+
+static void mgmt_set_events(mgmt_conn_t *conn, uint32_t events) {
+    struct epoll_event ev;
+
+    if (conn->events == events) {
+        return;
+    }
+    ev.events = events;
+    ev.data.u64 = mgmt_conn_index(conn) + MGMT_EV_CONN_BASE;
+    if (epoll_ctl(g_mgmt.epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) == 0) {
+        conn->events = events;
+    }
+}
+
+static void mgmt_close(mgmt_conn_t *conn) {
+    uint32_t index = mgmt_conn_index(conn);
+
+    epoll_ctl(g_mgmt.epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    mem_free(MEM_TAG_MGMT, conn->in);
+    mem_free(MEM_TAG_MGMT, conn->out);
+    // A slot on the pending list is skipped there, and freed once it is passed
+    memset(conn, 0, sizeof(*conn));
+    conn->fd = -1;
+    conn->next = g_mgmt.free_head;
+    g_mgmt.free_head = index;
+    mgmt_count(&g_mgmt.stats.connections, (uint64_t)-1);
+}
+
+/**
+ * @brief Write what the output buffer holds
+ *
+ * @return false if the connection was closed
+ */
+static bool mgmt_flush(mgmt_conn_t *conn) {
+    while (conn->out_off < conn->out_len) {
+        ssize_t n = send(conn->fd, conn->out + conn->out_off, conn->out_len - conn->out_off, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            mgmt_close(conn);
+            return false;
+        }
+        mgmt_count(&g_mgmt.stats.bytes_out, (uint64_t)n);
+        conn->out_off += (size_t)n;
+    }
+
+    if (conn->out_off == conn->out_len) {
+        conn->out_off = 0;
+        conn->out_len = 0;
+        if (conn->close_after) {
+            mgmt_close(conn);
+            return false;
+        }
+        mgmt_set_events(conn, EPOLLIN);
+    } else if (conn->out_len - conn->out_off >= MGMT_SERVER_OUTPUT_LIMIT || conn->close_after) {
+        // The client is not reading: no more requests until it catches up
+        if (conn->events != EPOLLOUT) {
+            mgmt_count(&g_mgmt.stats.throttled, 1);
+        }
+        mgmt_set_events(conn, EPOLLOUT);
+    } else {
+        mgmt_set_events(conn, EPOLLIN | EPOLLOUT);
+    }
+    return true;
+}
+
+static void mgmt_pending_push(mgmt_conn_t *conn) {
+    uint32_t index = mgmt_conn_index(conn);
+
+    if (conn->pending) {
+        return;
+    }
+    conn->pending = true;
+    conn->next = MGMT_NONE;
+    if (g_mgmt.pending_tail == MGMT_NONE) {
+        g_mgmt.pending_head = index;
+    } else {
+        g_mgmt.conns[g_mgmt.pending_tail].next = index;
+    }
+    g_mgmt.pending_tail = index;
+}
+
+/**
+ * @brief Answer up to CONFIG_MGMT_SERVER_REQUESTS_PER_EVENT buffered requests
+ */
+static void mgmt_serve(mgmt_conn_t *conn) {
+    uint32_t handled = 0;
+    bool stalled = false;
+
+    while (conn->in_len > 0 && !conn->close_after) {
+        size_t used;
+
+        if (handled == CONFIG_MGMT_SERVER_REQUESTS_PER_EVENT) {
+            mgmt_count(&g_mgmt.stats.deferred, 1);
+            mgmt_pending_push(conn);
+            break;
+        }
+        if (conn->out_len - conn->out_off >= MGMT_SERVER_OUTPUT_LIMIT) {
+            stalled = true;
+            break;
+        }
+        used = mgmt_handle_request(conn);
+        if (used == 0) {
+            break;
+        }
+        if (handled > 0) {
+            mgmt_count(&g_mgmt.stats.pipelined, 1);
+        }
+        handled++;
+        conn->in_len -= used;
+        memmove(conn->in, conn->in + used, conn->in_len);
+    }
+    if (conn->close_after) {
+        conn->in_len = 0;
+    }
+    // Held back by the output limit but written out at once: nothing else
+    // would bring the connection back for the requests left
+    if (mgmt_flush(conn) && stalled && (conn->events & EPOLLIN)) {
+        mgmt_pending_push(conn);
+    }
+}
+
+static void mgmt_read(mgmt_conn_t *conn) {
+    ssize_t n;
+
+    if (!mgmt_reserve(&conn->in, &conn->in_cap, conn->in_len + MGMT_INPUT_MIN)) {
+        mgmt_close(conn);
+        return;
+    }
+    size_t room = conn->in_cap - conn->in_len;
+    n = recv(conn->fd, conn->in + conn->in_len, room < MGMT_SERVER_READ_CHUNK ? room : MGMT_SERVER_READ_CHUNK, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        mgmt_close(conn);
+        return;
+    }
+    if (n < 0) {
+        return;
+    }
+    mgmt_count(&g_mgmt.stats.bytes_in, (uint64_t)n);
+    conn->in_len += (size_t)n;
+    conn->last_active_us = mgmt_now_us();
+    mgmt_serve(conn);
+}
+
+static void mgmt_accept(void) {
+    // Bounded like the rest: at most a batch of events' worth per wakeup
+    for (uint32_t i = 0; i < MGMT_MAX_EVENTS; i++) {
+        int fd = accept4(g_mgmt.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        struct epoll_event ev;
+        mgmt_conn_t *conn;
+        int one = 1;
+
+        if (fd < 0) {
+            return;
+        }
+        if (g_mgmt.free_head == MGMT_NONE) {
+            close(fd);
+            mgmt_count(&g_mgmt.stats.rejected, 1);
+            continue;
+        }
+        conn = &g_mgmt.conns[g_mgmt.free_head];
+        g_mgmt.free_head = conn->next;
+        memset(conn, 0, sizeof(*conn));
+        conn->fd = fd;
+        conn->next = MGMT_NONE;
+        conn->events = EPOLLIN;
+        conn->last_active_us = mgmt_now_us();
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        ev.events = EPOLLIN;
+        ev.data.u64 = mgmt_conn_index(conn) + MGMT_EV_CONN_BASE;
+        if (epoll_ctl(g_mgmt.epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            conn->fd = -1;
+            conn->next = g_mgmt.free_head;
+            g_mgmt.free_head = mgmt_conn_index(conn);
+            continue;
+        }
+        mgmt_count(&g_mgmt.stats.accepted, 1);
+        mgmt_count(&g_mgmt.stats.connections, 1);
+    }
+}
+
+static void mgmt_close_idle(uint64_t now_us) {
+    for (uint32_t i = 0; i < CONFIG_MGMT_SERVER_MAX_CONNECTIONS; i++) {
+        mgmt_conn_t *conn = &g_mgmt.conns[i];
+
+        if (conn->fd >= 0 && !conn->pending &&
+            now_us - conn->last_active_us > (uint64_t)MGMT_SERVER_IDLE_TIMEOUT_S * 1000000ULL) {
+            mgmt_close(conn);
+            mgmt_count(&g_mgmt.stats.idle_closed, 1);
+        }
+    }
+}
+
+static void *mgmt_thread_main(void *arg) {
+    struct epoll_event events[MGMT_MAX_EVENTS];
+    uint64_t next_idle_check = mgmt_now_us() + 1000000ULL;
+
+    (void)arg;
+    if (g_mgmt.cpu >= 0) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(g_mgmt.cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            LOG_WARNING(LOG_CATEGORY_SYSTEM, "Management server: cannot pin to CPU %d", g_mgmt.cpu);
+        }
+    }
+
+    while (__atomic_load_n(&g_mgmt.running, __ATOMIC_ACQUIRE)) {
+        int timeout = g_mgmt.pending_head != MGMT_NONE ? 0 : 1000;
+        int n = epoll_wait(g_mgmt.epoll_fd, events, MGMT_MAX_EVENTS, timeout);
+
+        for (int i = 0; i < n; i++) {
+            uint64_t id = events[i].data.u64;
+            mgmt_conn_t *conn;
+
+            if (id == MGMT_EV_LISTEN) {
+                mgmt_accept();
+                continue;
+            }
+            if (id == MGMT_EV_WAKE) {
+                continue;
+            }
+            conn = &g_mgmt.conns[id - MGMT_EV_CONN_BASE];
+            if (conn->fd < 0) {
+                continue;
+            }
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) && !(events[i].events & EPOLLIN)) {
+                mgmt_close(conn);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                if (!mgmt_flush(conn)) {
+                    continue;
+                }
+                // Requests held back while the client was not reading
+                if (conn->in_len > 0 && !conn->pending && (conn->events & EPOLLIN)) {
+                    mgmt_pending_push(conn);
+                }
+            }
+            if ((events[i].events & EPOLLIN) && (conn->events & EPOLLIN) && !conn->pending) {
+                mgmt_read(conn);
+            }
+        }
+
+        // One more turn for the connections left with requests, in order
+        uint32_t index = g_mgmt.pending_head;
+        g_mgmt.pending_head = MGMT_NONE;
+        g_mgmt.pending_tail = MGMT_NONE;
+        while (index != MGMT_NONE) {
+            mgmt_conn_t *conn = &g_mgmt.conns[index];
+            uint32_t next = conn->next;
+
+            conn->pending = false;
+            if (conn->fd >= 0) {
+                mgmt_serve(conn);
+            }
+            index = next;
+        }
+
+        uint64_t now = mgmt_now_us();
+        if (now >= next_idle_check) {
+            mgmt_close_idle(now);
+            next_idle_check = now + 1000000ULL;
+        }
+    }
+    return NULL;
+}
+
+/* ---- Control ---- */
+
+static void mgmt_release(void) {
+    if (g_mgmt.conns) {
+        for (uint32_t i = 0; i < CONFIG_MGMT_SERVER_MAX_CONNECTIONS; i++) {
+            if (g_mgmt.conns[i].fd >= 0) {
+                close(g_mgmt.conns[i].fd);
+                mem_free(MEM_TAG_MGMT, g_mgmt.conns[i].in);
+                mem_free(MEM_TAG_MGMT, g_mgmt.conns[i].out);
+            }
+        }
+    }
+    if (g_mgmt.epoll_fd >= 0) {
+        close(g_mgmt.epoll_fd);
+    }
+    if (g_mgmt.wake_fd >= 0) {
+        close(g_mgmt.wake_fd);
+    }
+    if (g_mgmt.listen_fd >= 0) {
+        close(g_mgmt.listen_fd);
+    }
+    mem_free(MEM_TAG_MGMT, g_mgmt.conns);
+    mem_free(MEM_TAG_MGMT, g_mgmt.text);
+    mem_free(MEM_TAG_MGMT, g_mgmt.scratch);
+    memset(&g_mgmt, 0, sizeof(g_mgmt));
+    g_mgmt.listen_fd = -1;
+    g_mgmt.wake_fd = -1;
+    g_mgmt.epoll_fd = -1;
+}
+
+static int mgmt_listen(const mgmt_server_config_t *config) {
+    struct sockaddr_in addr;
+    int one = 1;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config->port ? config->port : MGMT_SERVER_DEFAULT_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (config->address && inet_pton(AF_INET, config->address, &addr.sin_addr) != 1) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+status_t mgmt_server_start(const mgmt_server_config_t *config) {
+    static const mgmt_server_config_t defaults = { NULL, 0, -1 };
+    struct epoll_event ev;
+
+    if (g_mgmt.started) {
+        return STATUS_ALREADY_INITIALIZED;
+    }
+    if (!config) {
+        config = &defaults;
+    }
+
+    g_mgmt.conns = (mgmt_conn_t *)mem_calloc(MEM_TAG_MGMT, CONFIG_MGMT_SERVER_MAX_CONNECTIONS, sizeof(mgmt_conn_t));
+    g_mgmt.text = (char *)mem_malloc(MEM_TAG_MGMT, MGMT_TEXT_MAX);
+    if (!g_mgmt.conns || !g_mgmt.text) {
+        mgmt_release();
+        return STATUS_NO_MEMORY;
+    }
+    for (uint32_t i = 0; i < CONFIG_MGMT_SERVER_MAX_CONNECTIONS; i++) {
+        g_mgmt.conns[i].fd = -1;
+        g_mgmt.conns[i].next = i + 1 < CONFIG_MGMT_SERVER_MAX_CONNECTIONS ? i + 1 : MGMT_NONE;
+    }
+    g_mgmt.free_head = 0;
+    g_mgmt.pending_head = MGMT_NONE;
+    g_mgmt.pending_tail = MGMT_NONE;
+    g_mgmt.cpu = config->cpu;
+
+    g_mgmt.listen_fd = mgmt_listen(config);
+    if (g_mgmt.listen_fd < 0) {
+        status_t status = errno == EINVAL ? STATUS_INVALID_PARAMETER : STATUS_FAILURE;
+
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Management server: cannot listen on %s:%u: %s",
+                  config->address ? config->address : "*",
+                  config->port ? config->port : MGMT_SERVER_DEFAULT_PORT, strerror(errno));
+        mgmt_release();
+        return status;
+    }
+    g_mgmt.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    g_mgmt.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (g_mgmt.wake_fd < 0 || g_mgmt.epoll_fd < 0) {
+        mgmt_release();
+        return STATUS_FAILURE;
+    }
+    ev.events = EPOLLIN;
+    ev.data.u64 = MGMT_EV_LISTEN;
+    epoll_ctl(g_mgmt.epoll_fd, EPOLL_CTL_ADD, g_mgmt.listen_fd, &ev);
+    ev.data.u64 = MGMT_EV_WAKE;
+    epoll_ctl(g_mgmt.epoll_fd, EPOLL_CTL_ADD, g_mgmt.wake_fd, &ev);
+
+    __atomic_store_n(&g_mgmt.running, true, __ATOMIC_RELEASE);
+    if (pthread_create(&g_mgmt.thread, NULL, mgmt_thread_main, NULL) != 0) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Management server: cannot start the thread");
+        mgmt_release();
+        return STATUS_FAILURE;
+    }
+
+    g_mgmt.started = true;
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Management server: listening on %s:%u", config->address ? config->address : "*",
+             config->port ? config->port : MGMT_SERVER_DEFAULT_PORT);
+    return STATUS_SUCCESS;
+}
+
+status_t mgmt_server_stop(void) {
+    uint64_t one = 1;
+
+    if (!g_mgmt.started) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    __atomic_store_n(&g_mgmt.running, false, __ATOMIC_RELEASE);
+    if (write(g_mgmt.wake_fd, &one, sizeof(one)) < 0) {
+        // The thread still sees running cleared within a second
+    }
+    pthread_join(g_mgmt.thread, NULL);
+
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Management server: stopped after %llu requests",
+             (unsigned long long)g_mgmt.stats.requests);
+    mgmt_release();
+    return STATUS_SUCCESS;
+}
+
+status_t mgmt_server_get_stats(mgmt_server_stats_t *stats) {
+    if (!g_mgmt.started) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    stats->connections = __atomic_load_n(&g_mgmt.stats.connections, __ATOMIC_RELAXED);
+    stats->accepted = __atomic_load_n(&g_mgmt.stats.accepted, __ATOMIC_RELAXED);
+    stats->rejected = __atomic_load_n(&g_mgmt.stats.rejected, __ATOMIC_RELAXED);
+    stats->idle_closed = __atomic_load_n(&g_mgmt.stats.idle_closed, __ATOMIC_RELAXED);
+    stats->requests = __atomic_load_n(&g_mgmt.stats.requests, __ATOMIC_RELAXED);
+    stats->pipelined = __atomic_load_n(&g_mgmt.stats.pipelined, __ATOMIC_RELAXED);
+    stats->deferred = __atomic_load_n(&g_mgmt.stats.deferred, __ATOMIC_RELAXED);
+    stats->throttled = __atomic_load_n(&g_mgmt.stats.throttled, __ATOMIC_RELAXED);
+    stats->errors = __atomic_load_n(&g_mgmt.stats.errors, __ATOMIC_RELAXED);
+    stats->bytes_in = __atomic_load_n(&g_mgmt.stats.bytes_in, __ATOMIC_RELAXED);
+    stats->bytes_out = __atomic_load_n(&g_mgmt.stats.bytes_out, __ATOMIC_RELAXED);
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,620 @@
+/**
+ * @file sflow.c
+ * @brief sFlow version 5 agent: random packet sampling and counter polling
+ *
+ * The sample ring is the bounded queue of many producers and one consumer
+ * used by the event feed: every cell has a sequence number, producers
+ * claim a position by CAS on the tail. Sample pools and drops are sharded
+ * per thread and folded by the exporter once per export pass.
+ *
+ * A thread resets its countdowns when the rate generation differs from
+ * the one it last saw, checked once per burst. Ports without sampling
+ * count down from UINT32_MAX, so the per-frame path has no rate check.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "../../include/management/sflow.h"
+#include "../../include/common/logging.h"
+#include "../../include/common/threading.h"
+#include "../../include/common/sim_clock.h"
+#include "../../include/common/stats_shard.h"
+#include "../../include/hal/packet.h"
+#include "../../include/hal/port.h"
+
+#define SFLOW_COLLECTOR_PORT        6343
+#define SFLOW_RING_MASK             (CONFIG_SFLOW_RING_SIZE - 1)
+#define SFLOW_IF_INDEX(port)        ((uint32_t)(port) + 1)
+#define SFLOW_MAX_RATE              (1U << 30)
+
+/* XDR structure formats, enterprise 0 */
+#define SFLOW_FORMAT_FLOW_SAMPLE    1
+#define SFLOW_FORMAT_COUNTER_SAMPLE 2
+#define SFLOW_FORMAT_RAW_HEADER     1
+#define SFLOW_FORMAT_IF_COUNTERS    1
+#define SFLOW_HEADER_PROTO_ETHERNET 1
+#define SFLOW_ADDRESS_IPV4          1
+#define SFLOW_IF_TYPE_ETHERNET      6
+
+/** Frames carry no FCS; it is reported as stripped */
+#define SFLOW_FCS_LEN               4
+
+#define SFLOW_DATAGRAM_HEADER       28
+#define SFLOW_FLOW_SAMPLE_LEN       (8 + 32 + 8 + 16 + CONFIG_SFLOW_HEADER_BYTES)
+#define SFLOW_COUNTER_SAMPLE_LEN    (8 + 12 + 8 + 88)
+
+_Static_assert((CONFIG_SFLOW_RING_SIZE & SFLOW_RING_MASK) == 0, "sFlow ring size must be a power of two");
+_Static_assert(CONFIG_SFLOW_HEADER_BYTES % 4 == 0, "sFlow header capture must be a multiple of 4");
+_Static_assert(SFLOW_DATAGRAM_HEADER + SFLOW_FLOW_SAMPLE_LEN <= SFLOW_MAX_DATAGRAM,
+               "a flow sample must fit a datagram");
+
+/**
+ * @brief Sharded counters: sample pool and drops per port, then totals
+ */
+#define SFLOW_CTR_POOL(port)        ((size_t)(port) * 2)
+#define SFLOW_CTR_DROPS(port)       ((size_t)(port) * 2 + 1)
+#define SFLOW_CTR_SAMPLES           ((size_t)CONFIG_MAX_PORTS * 2)
+#define SFLOW_CTR_COUNT             (SFLOW_CTR_SAMPLES + 1)
+
+/**
+ * @brief Ring cell: position + 1 once written, position + ring size once read
+ */
+typedef struct {
+    uint64_t seq;
+    port_id_t port;
+    uint16_t header_length;         /**< Bytes captured */
+    uint32_t frame_length;          /**< Bytes of the frame, without FCS */
+    uint8_t header[CONFIG_SFLOW_HEADER_BYTES];
+} sflow_cell_t;
+
+/**
+ * @brief Sampling state of one forwarding thread
+ */
+typedef struct {
+    uint32_t generation;                    /**< Rate generation the countdowns follow */
+    uint64_t rng;                           /**< xorshift64* state */
+    uint32_t countdown[CONFIG_MAX_PORTS + 1]; /**< Frames to the next sample; last slot for bad ports */
+    uint32_t skip[CONFIG_MAX_PORTS];        /**< Skip the countdown started from */
+} sflow_thread_t;
+
+/**
+ * @brief Agent state
+ */
+static struct {
+    bool initialized;
+    spinlock_t lock;                        /* Serializes rate changes */
+    sflow_config_t config;                  /* host is not kept */
+    int fd;                                 /* Connected UDP socket */
+    uint32_t handle;                        /* Sampling stage */
+    uint32_t generation;                    /* Bumped on every rate change */
+    uint32_t rates[CONFIG_MAX_PORTS];
+    stats_shard_set_t *counters;            /* SFLOW_CTR_COUNT counters */
+    sflow_cell_t *cells;
+    uint64_t tail __attribute__((aligned(64)));    /* Next position of producers */
+    uint64_t head __attribute__((aligned(64)));    /* Next position of the exporter */
+
+    /* Exporter thread */
+    pthread_t thread;
+    bool running;
+    uint64_t start_us;
+    uint64_t next_counters_us;
+    uint64_t *totals;                       /* Counters folded for the current pass */
+    uint32_t datagram_seq;
+    uint32_t flow_seq[CONFIG_MAX_PORTS];
+    uint32_t counter_seq[CONFIG_MAX_PORTS];
+    uint8_t buf[SFLOW_MAX_DATAGRAM];
+    size_t len;                             /* Bytes in buf, header included */
+    uint32_t samples_in_buf;
+    uint64_t flow_samples_sent;
+    uint64_t counter_samples_sent;
+    uint64_t datagrams_sent;
+    uint64_t send_errors;
+} g_sflow = { .fd = -1 };
+
+static THREAD_LOCAL sflow_thread_t t_sflow;
+
+static inline uint64_t sflow_random(sflow_thread_t *t) {
+    t->rng ^= t->rng >> 12;
+    t->rng ^= t->rng << 25;
+    t->rng ^= t->rng >> 27;
+    return t->rng * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief Draw the frames to skip before the next sample, uniform in [1, 2 * rate - 1]
+ */
+static inline uint32_t sflow_next_skip(sflow_thread_t *t, uint32_t rate) {
+    if (rate <= 1) {
+        return 1;
+    }
+    return 1 + (uint32_t)(sflow_random(t) % (2 * (uint64_t)rate - 1));
+}
+
+/**
+ * @brief Restart every countdown of the calling thread from the current rates
+ */
+static void sflow_thread_reseed(sflow_thread_t *t, uint32_t generation) {
+    if (t->rng == 0) {
+        t->rng = ((uint64_t)(uintptr_t)t ^ (sim_clock_now_us() << 20)) | 1;
+    }
+    for (uint32_t port = 0; port < CONFIG_MAX_PORTS; port++) {
+        uint32_t rate = __atomic_load_n(&g_sflow.rates[port], __ATOMIC_RELAXED);
+
+        t->skip[port] = rate ? sflow_next_skip(t, rate) : 0;
+        t->countdown[port] = rate ? t->skip[port] : UINT32_MAX;
+    }
+    t->countdown[CONFIG_MAX_PORTS] = UINT32_MAX;
+    t->generation = generation;
+}
+
+/**
+ * @brief Queue the header of a sampled frame; slow path of the sampling stage
+ *
+ * @param t Thread state
+ * @param slot Countdown that expired
+ * @param packet Frame
+ */
+static void sflow_take_sample(sflow_thread_t *t, uint32_t slot, const packet_buffer_t *packet) {
+    uint32_t rate = slot < CONFIG_MAX_PORTS ? __atomic_load_n(&g_sflow.rates[slot], __ATOMIC_RELAXED) : 0;
+    uint64_t *ctr;
+    sflow_cell_t *cell;
+    uint32_t length;
+    uint64_t pos;
+
+    if (rate == 0) {
+        t->countdown[slot] = UINT32_MAX;
+        return;
+    }
+
+    ctr = stats_shard_local(g_sflow.counters);
+    stats_shard_add(&ctr[SFLOW_CTR_POOL(slot)], t->skip[slot]);
+    t->skip[slot] = sflow_next_skip(t, rate);
+    t->countdown[slot] = t->skip[slot];
+
+    pos = __atomic_load_n(&g_sflow.tail, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = &g_sflow.cells[pos & SFLOW_RING_MASK];
+        int64_t diff = (int64_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&g_sflow.tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /* The exporter has not freed the cell from a lap ago */
+            stats_shard_add(&ctr[SFLOW_CTR_DROPS(slot)], 1);
+            return;
+        } else {
+            pos = __atomic_load_n(&g_sflow.tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    length = packet_chain_length(packet);
+    cell->port = (port_id_t)slot;
+    cell->frame_length = length;
+    cell->header_length = (uint16_t)(length < CONFIG_SFLOW_HEADER_BYTES ? length : CONFIG_SFLOW_HEADER_BYTES);
+    if (packet_copy_data(packet, 0, cell->header, cell->header_length) != STATUS_SUCCESS) {
+        cell->header_length = 0;
+    }
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    stats_shard_add(&ctr[SFLOW_CTR_SAMPLES], 1);
+}
+
+/**
+ * @brief Sampling stage; forwards every frame
+ */
+static void sflow_sample_burst(packet_buffer_t **pkts, uint32_t count, packet_result_t *results,
+                               void *user_data) {
+    sflow_thread_t *t = &t_sflow;
+    uint32_t generation = __atomic_load_n(&g_sflow.generation, __ATOMIC_ACQUIRE);
+
+    (void)user_data;
+    if (__builtin_expect(t->generation != generation, 0)) {
+        sflow_thread_reseed(t, generation);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        port_id_t port = pkts[i]->metadata.port;
+        uint32_t slot = port < CONFIG_MAX_PORTS ? port : CONFIG_MAX_PORTS;
+
+        results[i] = PACKET_RESULT_FORWARD;
+        if (__builtin_expect(--t->countdown[slot] != 0, 1)) {
+            continue;
+        }
+        sflow_take_sample(t, slot, pkts[i]);
+    }
+}
+
+static inline uint8_t *put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+    return p + 4;
+}
+
+static inline uint8_t *put_u64(uint8_t *p, uint64_t v) {
+    return put_u32(put_u32(p, (uint32_t)(v >> 32)), (uint32_t)v);
+}
+
+/**
+ * @brief Send the datagram being built, if it has samples
+ */
+static void sflow_flush(void) {
+    uint8_t *p = g_sflow.buf;
+
+    if (g_sflow.samples_in_buf == 0) {
+        return;
+    }
+
+    p = put_u32(p, SFLOW_VERSION);
+    p = put_u32(p, SFLOW_ADDRESS_IPV4);
+    p = put_u32(p, g_sflow.config.agent_address);
+    p = put_u32(p, g_sflow.config.sub_agent_id);
+    p = put_u32(p, ++g_sflow.datagram_seq);
+    p = put_u32(p, (uint32_t)((sim_clock_now_us() - g_sflow.start_us) / 1000));
+    put_u32(p, g_sflow.samples_in_buf);
+
+    if (send(g_sflow.fd, g_sflow.buf, g_sflow.len, MSG_DONTWAIT) < 0) {
+        __atomic_store_n(&g_sflow.send_errors, g_sflow.send_errors + 1, __ATOMIC_RELAXED);
+        LOG_DEBUG(LOG_CATEGORY_SYSTEM, "sFlow: send failed: %s", strerror(errno));
+    } else {
+        __atomic_store_n(&g_sflow.datagrams_sent, g_sflow.datagrams_sent + 1, __ATOMIC_RELAXED);
+    }
+    g_sflow.len = SFLOW_DATAGRAM_HEADER;
+    g_sflow.samples_in_buf = 0;
+}
+
+/**
+ * @brief Room for a sample of length bytes, flushing first if needed
+ */
+static uint8_t *sflow_reserve(size_t length) {
+    uint8_t *p;
+
+    if (g_sflow.len + length > SFLOW_MAX_DATAGRAM) {
+        sflow_flush();
+    }
+    p = g_sflow.buf + g_sflow.len;
+    g_sflow.len += length;
+    g_sflow.samples_in_buf++;
+    return p;
+}
+
+/**
+ * @brief Add a flow sample for a queued header
+ */
+static void sflow_add_flow_sample(const sflow_cell_t *cell) {
+    port_id_t port = cell->port;
+    uint32_t padded = (cell->header_length + 3u) & ~3u;
+    uint32_t length = SFLOW_FLOW_SAMPLE_LEN - CONFIG_SFLOW_HEADER_BYTES + padded;
+    uint8_t *p = sflow_reserve(length);
+
+    p = put_u32(p, SFLOW_FORMAT_FLOW_SAMPLE);
+    p = put_u32(p, length - 8);
+    p = put_u32(p, ++g_sflow.flow_seq[port]);
+    p = put_u32(p, SFLOW_IF_INDEX(port));
+    p = put_u32(p, __atomic_load_n(&g_sflow.rates[port], __ATOMIC_RELAXED));
+    p = put_u32(p, (uint32_t)g_sflow.totals[SFLOW_CTR_POOL(port)]);
+    p = put_u32(p, (uint32_t)g_sflow.totals[SFLOW_CTR_DROPS(port)]);
+    p = put_u32(p, SFLOW_IF_INDEX(port));
+    p = put_u32(p, 0);
+    p = put_u32(p, 1);
+
+    p = put_u32(p, SFLOW_FORMAT_RAW_HEADER);
+    p = put_u32(p, 16 + padded);
+    p = put_u32(p, SFLOW_HEADER_PROTO_ETHERNET);
+    p = put_u32(p, cell->frame_length + SFLOW_FCS_LEN);
+    p = put_u32(p, SFLOW_FCS_LEN);
+    p = put_u32(p, cell->header_length);
+    memcpy(p, cell->header, cell->header_length);
+    memset(p + cell->header_length, 0, padded - cell->header_length);
+
+    __atomic_store_n(&g_sflow.flow_samples_sent, g_sflow.flow_samples_sent + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Add a generic interface counter sample of a port
+ */
+static void sflow_add_counter_sample(port_id_t port) {
+    port_info_t info;
+    uint8_t *p;
+
+    if (port_get_info(port, &info) != STATUS_SUCCESS) {
+        return;
+    }
+
+    p = sflow_reserve(SFLOW_COUNTER_SAMPLE_LEN);
+    p = put_u32(p, SFLOW_FORMAT_COUNTER_SAMPLE);
+    p = put_u32(p, SFLOW_COUNTER_SAMPLE_LEN - 8);
+    p = put_u32(p, ++g_sflow.counter_seq[port]);
+    p = put_u32(p, SFLOW_IF_INDEX(port));
+    p = put_u32(p, 1);
+
+    p = put_u32(p, SFLOW_FORMAT_IF_COUNTERS);
+    p = put_u32(p, 88);
+    p = put_u32(p, SFLOW_IF_INDEX(port));
+    p = put_u32(p, SFLOW_IF_TYPE_ETHERNET);
+    p = put_u64(p, (uint64_t)info.config.speed * 1000000ULL);
+    p = put_u32(p, info.config.duplex == PORT_DUPLEX_FULL ? 1 : info.config.duplex == PORT_DUPLEX_HALF ? 2 : 0);
+    p = put_u32(p, (info.config.admin_state ? 1u : 0u) | (info.state == PORT_STATE_UP ? 2u : 0u));
+    p = put_u64(p, info.stats.rx_bytes);
+    p = put_u32(p, (uint32_t)info.stats.rx_unicast);
+    p = put_u32(p, (uint32_t)info.stats.rx_multicast);
+    p = put_u32(p, (uint32_t)info.stats.rx_broadcast);
+    p = put_u32(p, (uint32_t)info.stats.rx_drops);
+    p = put_u32(p, (uint32_t)info.stats.rx_errors);
+    p = put_u32(p, 0);
+    p = put_u64(p, info.stats.tx_bytes);
+    p = put_u32(p, (uint32_t)info.stats.tx_unicast);
+    p = put_u32(p, (uint32_t)info.stats.tx_multicast);
+    p = put_u32(p, (uint32_t)info.stats.tx_broadcast);
+    p = put_u32(p, (uint32_t)info.stats.tx_drops);
+    p = put_u32(p, (uint32_t)info.stats.tx_errors);
+    put_u32(p, 0);
+
+    __atomic_store_n(&g_sflow.counter_samples_sent, g_sflow.counter_samples_sent + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief One export pass: every queued sample, then counters when due
+ *
+ * @param final Pass at shutdown, counters are not polled
+ */
+static void sflow_export(bool final) {
+    uint64_t now = sim_clock_now_us();
+
+    stats_shard_fold(g_sflow.counters, 0, SFLOW_CTR_COUNT, g_sflow.totals);
+
+    for (;;) {
+        uint64_t pos = g_sflow.head;
+        sflow_cell_t *cell = &g_sflow.cells[pos & SFLOW_RING_MASK];
+
+        if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+            break;
+        }
+        sflow_add_flow_sample(cell);
+        __atomic_store_n(&cell->seq, pos + CONFIG_SFLOW_RING_SIZE, __ATOMIC_RELEASE);
+        g_sflow.head = pos + 1;
+    }
+
+    if (!final && now >= g_sflow.next_counters_us) {
+        for (port_id_t port = 0; port < CONFIG_MAX_PORTS; port++) {
+            if (__atomic_load_n(&g_sflow.rates[port], __ATOMIC_RELAXED)) {
+                sflow_add_counter_sample(port);
+            }
+        }
+        g_sflow.next_counters_us = now + (uint64_t)g_sflow.config.counter_interval_s * 1000000ULL;
+    }
+
+    sflow_flush();
+}
+
+static void *sflow_exporter_main(void *arg) {
+    struct timespec ts;
+
+    (void)arg;
+    ts.tv_sec = g_sflow.config.flush_interval_ms / 1000;
+    ts.tv_nsec = (long)(g_sflow.config.flush_interval_ms % 1000) * 1000000L;
+
+    while (__atomic_load_n(&g_sflow.running, __ATOMIC_ACQUIRE)) {
+        nanosleep(&ts, NULL);
+        sflow_export(false);
+    }
+    sflow_export(true);
+    return NULL;
+}
+
+/**
+ * @brief Open a UDP socket connected to the collector
+ */
+static int sflow_connect(const char *host, uint16_t port) {
+    struct addrinfo hints, *res = NULL;
+    char service[8];
+    int fd = -1;
+    int rc;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    snprintf(service, sizeof(service), "%u", port);
+    rc = getaddrinfo(host, service, &hints, &res);
+    if (rc != 0) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "sFlow: cannot resolve %s: %s", host, gai_strerror(rc));
+        return -1;
+    }
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "sFlow: cannot reach %s:%u", host, port);
+    }
+    return fd;
+}
+
+/**
+ * @brief Free whatever sflow_init() set up
+ */
+static void sflow_release(void) {
+    if (g_sflow.fd >= 0) {
+        close(g_sflow.fd);
+        g_sflow.fd = -1;
+    }
+    stats_shard_destroy(g_sflow.counters);
+    g_sflow.counters = NULL;
+    free(g_sflow.cells);
+    g_sflow.cells = NULL;
+    free(g_sflow.totals);
+    g_sflow.totals = NULL;
+}
+
+status_t sflow_init(const sflow_config_t *config) {
+    status_t status;
+
+    if (!config || !config->host) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (g_sflow.initialized) {
+        return STATUS_ALREADY_INITIALIZED;
+    }
+
+    g_sflow.config = *config;
+    g_sflow.config.host = NULL;
+    if (g_sflow.config.port == 0) {
+        g_sflow.config.port = SFLOW_COLLECTOR_PORT;
+    }
+    if (g_sflow.config.flush_interval_ms == 0) {
+        g_sflow.config.flush_interval_ms = SFLOW_DEFAULT_FLUSH_MS;
+    }
+    if (g_sflow.config.counter_interval_s == 0) {
+        g_sflow.config.counter_interval_s = SFLOW_DEFAULT_COUNTER_INTERVAL_S;
+    }
+
+    g_sflow.cells = (sflow_cell_t *)calloc(CONFIG_SFLOW_RING_SIZE, sizeof(sflow_cell_t));
+    g_sflow.totals = (uint64_t *)calloc(SFLOW_CTR_COUNT, sizeof(uint64_t));
+    if (!g_sflow.cells || !g_sflow.totals) {
+        sflow_release();
+        return STATUS_NO_MEMORY;
+    }
+    for (uint32_t i = 0; i < CONFIG_SFLOW_RING_SIZE; i++) {
+        g_sflow.cells[i].seq = i;
+    }
+    g_sflow.head = 0;
+    g_sflow.tail = 0;
+
+    status = stats_shard_create(SFLOW_CTR_COUNT, &g_sflow.counters);
+    if (status != STATUS_SUCCESS) {
+        sflow_release();
+        return status;
+    }
+
+    g_sflow.fd = sflow_connect(config->host, g_sflow.config.port);
+    if (g_sflow.fd < 0) {
+        sflow_release();
+        return STATUS_FAILURE;
+    }
+
+    memset(g_sflow.rates, 0, sizeof(g_sflow.rates));
+    memset(g_sflow.flow_seq, 0, sizeof(g_sflow.flow_seq));
+    memset(g_sflow.counter_seq, 0, sizeof(g_sflow.counter_seq));
+    spinlock_init(&g_sflow.lock);
+    g_sflow.len = SFLOW_DATAGRAM_HEADER;
+    g_sflow.samples_in_buf = 0;
+    g_sflow.datagram_seq = 0;
+    g_sflow.flow_samples_sent = 0;
+    g_sflow.counter_samples_sent = 0;
+    g_sflow.datagrams_sent = 0;
+    g_sflow.send_errors = 0;
+    g_sflow.start_us = sim_clock_now_us();
+    g_sflow.next_counters_us = g_sflow.start_us + (uint64_t)g_sflow.config.counter_interval_s * 1000000ULL;
+    /* Never 0, so threads that never sampled reseed on their first burst */
+    __atomic_store_n(&g_sflow.generation, g_sflow.generation + 1 ? g_sflow.generation + 1 : 1,
+                     __ATOMIC_RELEASE);
+
+    __atomic_store_n(&g_sflow.running, true, __ATOMIC_RELEASE);
+    if (pthread_create(&g_sflow.thread, NULL, sflow_exporter_main, NULL) != 0) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "sFlow: cannot start the exporter");
+        g_sflow.running = false;
+        sflow_release();
+        return STATUS_FAILURE;
+    }
+
+    status = packet_register_burst_processor(sflow_sample_burst, SFLOW_PROCESSOR_PRIORITY, NULL,
+                                             &g_sflow.handle);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "sFlow: failed to register the sampling stage: %d", status);
+        __atomic_store_n(&g_sflow.running, false, __ATOMIC_RELEASE);
+        pthread_join(g_sflow.thread, NULL);
+        sflow_release();
+        return status;
+    }
+    packet_set_processor_name(g_sflow.handle, "sflow");
+
+    g_sflow.initialized = true;
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "sFlow: exporting to %s:%u every %u ms", config->host,
+             g_sflow.config.port, g_sflow.config.flush_interval_ms);
+    return STATUS_SUCCESS;
+}
+
+status_t sflow_shutdown(void) {
+    if (!g_sflow.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    packet_unregister_processor(g_sflow.handle);
+    __atomic_store_n(&g_sflow.running, false, __ATOMIC_RELEASE);
+    pthread_join(g_sflow.thread, NULL);
+    g_sflow.initialized = false;
+    sflow_release();
+
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "sFlow: stopped after %llu datagrams",
+             (unsigned long long)g_sflow.datagrams_sent);
+    return STATUS_SUCCESS;
+}
+
+status_t sflow_set_port_rate(port_id_t port_id, uint32_t rate) {
+    if (!g_sflow.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (port_id >= CONFIG_MAX_PORTS || rate > SFLOW_MAX_RATE) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    spinlock_acquire(&g_sflow.lock);
+    __atomic_store_n(&g_sflow.rates[port_id], rate, __ATOMIC_RELAXED);
+    uint32_t generation = g_sflow.generation + 1;
+    __atomic_store_n(&g_sflow.generation, generation ? generation : 1, __ATOMIC_RELEASE);
+    spinlock_release(&g_sflow.lock);
+
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "sFlow: port %u sampled 1 in %u", port_id, rate);
+    return STATUS_SUCCESS;
+}
+
+uint32_t sflow_get_port_rate(port_id_t port_id) {
+    if (port_id >= CONFIG_MAX_PORTS) {
+        return 0;
+    }
+    return __atomic_load_n(&g_sflow.rates[port_id], __ATOMIC_RELAXED);
+}
+
+status_t sflow_get_stats(sflow_stats_t *stats) {
+    uint64_t drops = 0;
+
+    if (!stats) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (!g_sflow.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    for (port_id_t port = 0; port < CONFIG_MAX_PORTS; port++) {
+        uint64_t value;
+
+        stats_shard_fold(g_sflow.counters, SFLOW_CTR_DROPS(port), 1, &value);
+        drops += value;
+    }
+    stats_shard_fold(g_sflow.counters, SFLOW_CTR_SAMPLES, 1, &stats->samples);
+    stats->ring_drops = drops;
+    stats->flow_samples_sent = __atomic_load_n(&g_sflow.flow_samples_sent, __ATOMIC_RELAXED);
+    stats->counter_samples_sent = __atomic_load_n(&g_sflow.counter_samples_sent, __ATOMIC_RELAXED);
+    stats->datagrams_sent = __atomic_load_n(&g_sflow.datagrams_sent, __ATOMIC_RELAXED);
+    stats->send_errors = __atomic_load_n(&g_sflow.send_errors, __ATOMIC_RELAXED);
+    return STATUS_SUCCESS;
+}
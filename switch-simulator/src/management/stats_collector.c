@@ -8,33 +8,46 @@
 #include <time.h>
 #include <pthread.h>
 #include "../../include/management/stats.h"
+#include "../../include/management/stats_export.h"
+#include "../../include/management/telemetry.h"
+#include "../../include/management/stats_threshold.h"
+#include "../../include/management/stats_history.h"
+#include "../../include/common/bitmap.h"
 #include "../../include/common/logging.h"
 #include "../../include/common/error_codes.h"
 #include "../../include/hal/port.h"
+#include "../../include/l2/storm_control.h"
+#include "../../include/l2/vlan.h"
+#include "../../include/hal/qos.h"
+#include "../../include/hal/int_telemetry.h"
 
-#define MAX_PORTS 64
 #define MAX_VLANS 4096
 #define MAX_QUEUES_PER_PORT 8
-#define MAX_CALLBACKS 32
 
 /**
- * @brief Threshold callback structure
+ * @brief Stored statistics of one VLAN
  */
 typedef struct {
-    char stat_type[32];
-    uint64_t threshold;
-    void (*callback)(void *user_data);
-    void *user_data;
-    bool active;
-} threshold_callback_t;
+    vlan_id_t vlan_id;
+    vlan_stats_t stats;
+} stats_vlan_entry_t;
 
 /**
  * @brief Private statistics context structure
+ *
+ * Port and queue storage is sized for the ports that exist. VLANs only
+ * get an entry once they are active, kept sorted by VLAN ID; a VLAN
+ * without one reads as cleared when the module started.
  */
 typedef struct {
-    port_stats_t port_stats[MAX_PORTS];
-    vlan_stats_t vlan_stats[MAX_VLANS];
-    queue_stats_t queue_stats[MAX_PORTS][MAX_QUEUES_PER_PORT];
+    uint32_t num_ports;                 // Ports at initialization
+    port_stats_t *port_stats;           // num_ports entries
+    queue_stats_t *queue_stats;         // num_ports * MAX_QUEUES_PER_PORT entries
+    stats_vlan_entry_t *vlans;          // Entries of active VLANs, sorted by VLAN ID
+    uint32_t vlan_count;
+    uint32_t vlan_capacity;
+    uint64_t vlan_present[VLAN_ID_WORDS]; // VLANs with an entry
+    time_t start_time;                  // last_clear of VLANs without an entry
     routing_stats_t routing_stats;
     
     pthread_t collection_thread;
@@ -42,10 +55,150 @@ typedef struct {
     bool collection_active;
     uint32_t collection_interval_ms;
     
-    threshold_callback_t callbacks[MAX_CALLBACKS];
-    size_t callback_count;
+    stats_threshold_engine_t *thresholds; // Created with the first threshold
+    
+    stats_export_t *export;             // Shared-memory segment, NULL if not exported
+    uint64_t exported_vlans[VLAN_ID_WORDS]; // VLAN records written in the segment
+    
+    telemetry_t *telemetry;             // Streaming exporter, NULL if disabled
+    pthread_t telemetry_thread;
+    bool telemetry_active;
+    pthread_mutex_t export_mutex;       // Serializes publishing with enable/disable
+    
+    stats_history_t *history;           // Counter time series, NULL if disabled
+    pthread_t history_thread;
+    bool history_active;
+    pthread_mutex_t history_mutex;      // Keeps queries off a history being destroyed
 } stats_private_t;
 
+/**
+ * @brief Receives one record from stats_gather()
+ *
+ * counters points to a stats_export_*_t record of the object type.
+ */
+typedef void (*stats_record_fn_t)(void *arg, telemetry_object_t obj, uint32_t index,
+                                  const uint64_t *counters);
+
+static void stats_gather(stats_context_t *ctx, uint32_t objects, uint64_t *active,
+                         stats_record_fn_t fn, void *arg);
+static void stats_publish_export(stats_context_t *ctx);
+
+/**
+ * @brief Find the entry of a VLAN; called with stats_mutex held
+ *
+ * @return Index of the entry, or of the first entry after vlan_id if none
+ */
+static uint32_t stats_vlan_search(const stats_private_t *priv, vlan_id_t vlan_id) {
+    uint32_t lo = 0;
+    uint32_t hi = priv->vlan_count;
+    
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (priv->vlans[mid].vlan_id < vlan_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @brief Get the entry of a VLAN; called with stats_mutex held
+ *
+ * @return Entry, NULL if the VLAN has none
+ */
+static stats_vlan_entry_t *stats_vlan_find(stats_private_t *priv, vlan_id_t vlan_id) {
+    if (!bitmap_test(priv->vlan_present, vlan_id)) {
+        return NULL;
+    }
+    return &priv->vlans[stats_vlan_search(priv, vlan_id)];
+}
+
+/**
+ * @brief Get the entry of a VLAN, adding it if needed; called with stats_mutex held
+ *
+ * @return Entry, NULL if out of memory
+ */
+static stats_vlan_entry_t *stats_vlan_get(stats_private_t *priv, vlan_id_t vlan_id) {
+    stats_vlan_entry_t *entry = stats_vlan_find(priv, vlan_id);
+    uint32_t pos;
+    
+    if (entry) {
+        return entry;
+    }
+    
+    if (priv->vlan_count == priv->vlan_capacity) {
+        uint32_t capacity = priv->vlan_capacity ? priv->vlan_capacity * 2 : 16;
+        stats_vlan_entry_t *vlans = (stats_vlan_entry_t *)realloc(priv->vlans, capacity * sizeof(*vlans));
+        if (!vlans) {
+            return NULL;
+        }
+        priv->vlans = vlans;
+        priv->vlan_capacity = capacity;
+    }
+    
+    pos = stats_vlan_search(priv, vlan_id);
+    memmove(&priv->vlans[pos + 1], &priv->vlans[pos], (priv->vlan_count - pos) * sizeof(*priv->vlans));
+    priv->vlan_count++;
+    
+    entry = &priv->vlans[pos];
+    memset(entry, 0, sizeof(*entry));
+    entry->vlan_id = vlan_id;
+    entry->stats.last_clear = priv->start_time;
+    bitmap_set(priv->vlan_present, vlan_id);
+    return entry;
+}
+
+/**
+ * @brief Bring the VLAN entries in line with the active VLANs; called with stats_mutex held
+ *
+ * Entries of deleted VLANs are dropped and new VLANs get one, so the
+ * entries are exactly the active VLANs afterwards.
+ */
+static void stats_vlan_sync(stats_private_t *priv) {
+    uint64_t active[VLAN_ID_WORDS];
+    uint32_t kept = 0;
+    
+    if (vlan_get_active_bitmap(active) != STATUS_SUCCESS) {
+        return;
+    }
+    
+    for (uint32_t i = 0; i < priv->vlan_count; i++) {
+        vlan_id_t id = priv->vlans[i].vlan_id;
+        if (bitmap_test(active, id)) {
+            priv->vlans[kept++] = priv->vlans[i];
+        } else {
+            bitmap_clear(priv->vlan_present, id);
+        }
+    }
+    priv->vlan_count = kept;
+    
+    bitmap_andnot(active, active, priv->vlan_present, VLAN_ID_WORDS);
+    BITMAP_FOR_EACH(vlan_id, active, VLAN_ID_WORDS) {
+        if (!stats_vlan_get(priv, (vlan_id_t)vlan_id)) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Index range and counters per record of each object type, for stats_gather() consumers
+ */
+static void stats_record_layout(const stats_private_t *priv, uint32_t counts[TELEMETRY_OBJ_COUNT],
+                                uint32_t words[TELEMETRY_OBJ_COUNT]) {
+    counts[TELEMETRY_OBJ_PORT] = priv->num_ports;
+    counts[TELEMETRY_OBJ_VLAN] = MAX_VLANS;
+    counts[TELEMETRY_OBJ_QUEUE] = priv->num_ports * MAX_QUEUES_PER_PORT;
+    counts[TELEMETRY_OBJ_ROUTING] = 1;
+    counts[TELEMETRY_OBJ_INT] = CONFIG_INT_SINK_SLOTS;
+    words[TELEMETRY_OBJ_PORT] = sizeof(stats_export_port_t) / sizeof(uint64_t);
+    words[TELEMETRY_OBJ_VLAN] = sizeof(stats_export_vlan_t) / sizeof(uint64_t);
+    words[TELEMETRY_OBJ_QUEUE] = sizeof(stats_export_queue_t) / sizeof(uint64_t);
+    words[TELEMETRY_OBJ_ROUTING] = sizeof(stats_export_routing_t) / sizeof(uint64_t);
+    words[TELEMETRY_OBJ_INT] = sizeof(stats_export_int_t) / sizeof(uint64_t);
+}
+
 /**
  * @brief Collection thread function
  */
@@ -60,33 +213,18 @@ static void* stats_collection_thread(void *arg) {
         // In a simulator, we need to get this data from the simulation engine
         // For now, we'll just have placeholder code
         
-        // Example: check thresholds and trigger callbacks
-        pthread_mutex_lock(&priv->stats_mutex);
-        
-        // Check each registered callback to see if its threshold is exceeded
-        for (size_t i = 0; i < priv->callback_count; i++) {
-            threshold_callback_t *cb = &priv->callbacks[i];
-            if (cb->active) {
-                // Example: check if the callback is for a port's rx_packets
-                if (strncmp(cb->stat_type, "port_rx_packets", 15) == 0) {
-                    // Extract port ID from format like "port_rx_packets_1"
-                    char *port_id_str = strchr(cb->stat_type, '_');
-                    if (port_id_str && (port_id_str = strchr(port_id_str + 1, '_')) &&
-                        (port_id_str = strchr(port_id_str + 1, '_'))) {
-                        
-                        port_id_t port_id = atoi(port_id_str + 1);
-                        if (port_id < MAX_PORTS && 
-                            priv->port_stats[port_id].rx_packets > cb->threshold) {
-                            // Threshold exceeded, call the callback
-                            cb->callback(cb->user_data);
-                        }
-                    }
-                }
-                // Additional cases for other stat types would go here
-            }
+        // Check thresholds; their callbacks run on the engine's dispatcher thread
+        stats_threshold_engine_t *thresholds = __atomic_load_n(&priv->thresholds, __ATOMIC_ACQUIRE);
+        uint32_t objects = thresholds ? stats_threshold_objects(thresholds) : 0;
+        if (objects) {
+            uint64_t active[VLAN_ID_WORDS];
+            
+            stats_threshold_begin(thresholds);
+            stats_gather(ctx, objects, active, stats_threshold_record, thresholds);
+            stats_threshold_evaluate(thresholds);
         }
         
-        pthread_mutex_unlock(&priv->stats_mutex);
+        stats_publish_export(ctx);
         
         // Sleep for the collection interval
         struct timespec ts;
@@ -109,31 +247,61 @@ error_code_t stats_init(stats_context_t *ctx) {
         return ERROR_OUT_OF_MEMORY;
     }
     
+    // Storage follows the ports that exist, not the compile-time maximum
+    if (port_get_count(&priv->num_ports) != STATUS_SUCCESS || priv->num_ports == 0 ||
+        priv->num_ports > CONFIG_MAX_PORTS) {
+        priv->num_ports = CONFIG_MAX_PORTS;
+    }
+    priv->port_stats = (port_stats_t *)calloc(priv->num_ports, sizeof(port_stats_t));
+    priv->queue_stats = (queue_stats_t *)calloc((size_t)priv->num_ports * MAX_QUEUES_PER_PORT,
+                                                sizeof(queue_stats_t));
+    if (!priv->port_stats || !priv->queue_stats) {
+        free(priv->port_stats);
+        free(priv->queue_stats);
+        free(priv);
+        return ERROR_OUT_OF_MEMORY;
+    }
+    
     // Initialize mutex
     if (pthread_mutex_init(&priv->stats_mutex, NULL) != 0) {
+        free(priv->port_stats);
+        free(priv->queue_stats);
+        free(priv);
+        return ERROR_INTERNAL;
+    }
+    if (pthread_mutex_init(&priv->export_mutex, NULL) != 0) {
+        pthread_mutex_destroy(&priv->stats_mutex);
+        free(priv->port_stats);
+        free(priv->queue_stats);
+        free(priv);
+        return ERROR_INTERNAL;
+    }
+    if (pthread_mutex_init(&priv->history_mutex, NULL) != 0) {
+        pthread_mutex_destroy(&priv->export_mutex);
+        pthread_mutex_destroy(&priv->stats_mutex);
+        free(priv->port_stats);
+        free(priv->queue_stats);
         free(priv);
         return ERROR_INTERNAL;
     }
     
     // Set initial timestamps for all counters
     time_t current_time = time(NULL);
-    for (int i = 0; i < MAX_PORTS; i++) {
+    for (uint32_t i = 0; i < priv->num_ports; i++) {
         priv->port_stats[i].last_clear = current_time;
         for (int j = 0; j < MAX_QUEUES_PER_PORT; j++) {
-            priv->queue_stats[i][j].last_clear = current_time;
+            priv->queue_stats[i * MAX_QUEUES_PER_PORT + j].last_clear = current_time;
         }
     }
     
-    for (int i = 0; i < MAX_VLANS; i++) {
-        priv->vlan_stats[i].last_clear = current_time;
-    }
+    priv->start_time = current_time;
+    stats_vlan_sync(priv);
     
     priv->routing_stats.last_clear = current_time;
     
     // Initialize collection thread parameters
     priv->collection_active = false;
     priv->collection_interval_ms = 1000; // Default 1 second
-    priv->callback_count = 0;
     
     // Store private data in context
     ctx->private_data = priv;
@@ -143,16 +311,26 @@ error_code_t stats_init(stats_context_t *ctx) {
 }
 
 error_code_t stats_get_port(stats_context_t *ctx, port_id_t port_id, port_stats_t *stats) {
-    if (!ctx || !ctx->private_data || !stats || port_id >= MAX_PORTS) {
+    if (!ctx || !ctx->private_data || !stats) {
         return ERROR_INVALID_PARAMETER;
     }
     
     stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    if (port_id >= priv->num_ports) {
+        return ERROR_INVALID_PARAMETER;
+    }
     
     pthread_mutex_lock(&priv->stats_mutex);
     memcpy(stats, &priv->port_stats[port_id], sizeof(port_stats_t));
     pthread_mutex_unlock(&priv->stats_mutex);
     
+    // Port traffic is counted live by the hardware simulation
+    port_stats_t live;
+    if (port_is_valid(port_id) && port_get_stats(port_id, &live) == STATUS_SUCCESS) {
+        live.last_clear = stats->last_clear;
+        memcpy(stats, &live, sizeof(port_stats_t));
+    }
+    
     return ERROR_NONE;
 }
 
@@ -164,25 +342,59 @@ error_code_t stats_get_vlan(stats_context_t *ctx, vlan_id_t vlan_id, vlan_stats_
     stats_private_t *priv = (stats_private_t *)ctx->private_data;
     
     pthread_mutex_lock(&priv->stats_mutex);
-    memcpy(stats, &priv->vlan_stats[vlan_id], sizeof(vlan_stats_t));
+    const stats_vlan_entry_t *entry = stats_vlan_find(priv, vlan_id);
+    if (entry) {
+        memcpy(stats, &entry->stats, sizeof(vlan_stats_t));
+    } else {
+        memset(stats, 0, sizeof(vlan_stats_t));
+        stats->last_clear = priv->start_time;
+    }
     pthread_mutex_unlock(&priv->stats_mutex);
     
+    // Storm control drops are counted live by the L2 policers
+    storm_counters_t storm;
+    if (storm_control_get_vlan_counters(vlan_id, &storm) == STATUS_SUCCESS) {
+        stats->storm_dropped_packets = storm.dropped_packets;
+        stats->storm_dropped_bytes = storm.dropped_bytes;
+    }
+    
+    // Traffic is counted live in the VLAN module's per-thread shards
+    vlan_counters_t counters;
+    if (vlan_get_counters(vlan_id, &counters) == STATUS_SUCCESS) {
+        stats->rx_packets = counters.rx_packets;
+        stats->rx_bytes = counters.rx_bytes;
+        stats->tx_packets = counters.tx_packets;
+        stats->tx_bytes = counters.tx_bytes;
+    }
+    
     return ERROR_NONE;
 }
 
 error_code_t stats_get_queue(stats_context_t *ctx, port_id_t port_id, 
                              uint8_t queue_id, queue_stats_t *stats) {
-    if (!ctx || !ctx->private_data || !stats || 
-        port_id >= MAX_PORTS || queue_id >= MAX_QUEUES_PER_PORT) {
+    if (!ctx || !ctx->private_data || !stats || queue_id >= MAX_QUEUES_PER_PORT) {
         return ERROR_INVALID_PARAMETER;
     }
     
     stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    if (port_id >= priv->num_ports) {
+        return ERROR_INVALID_PARAMETER;
+    }
     
     pthread_mutex_lock(&priv->stats_mutex);
-    memcpy(stats, &priv->queue_stats[port_id][queue_id], sizeof(queue_stats_t));
+    memcpy(stats, &priv->queue_stats[port_id * MAX_QUEUES_PER_PORT + queue_id], sizeof(queue_stats_t));
     pthread_mutex_unlock(&priv->stats_mutex);
     
+    // Egress queue counters are kept live by the QoS scheduler
+    qos_queue_stats_t qos;
+    if (qos_get_queue_stats(port_id, queue_id, &qos) == STATUS_SUCCESS) {
+        stats->enqueued = qos.enqueued;
+        stats->dequeued = qos.dequeued;
+        stats->dropped = qos.tail_drops + qos.wred_drops;
+        stats->current_depth = qos.depth;
+        stats->max_depth = qos.max_depth;
+    }
+    
     return ERROR_NONE;
 }
 
@@ -201,17 +413,24 @@ error_code_t stats_get_routing(stats_context_t *ctx, routing_stats_t *stats) {
 }
 
 error_code_t stats_clear_port(stats_context_t *ctx, port_id_t port_id) {
-    if (!ctx || !ctx->private_data || port_id >= MAX_PORTS) {
+    if (!ctx || !ctx->private_data) {
         return ERROR_INVALID_PARAMETER;
     }
     
     stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    if (port_id >= priv->num_ports) {
+        return ERROR_INVALID_PARAMETER;
+    }
     
     pthread_mutex_lock(&priv->stats_mutex);
     memset(&priv->port_stats[port_id], 0, sizeof(port_stats_t));
     priv->port_stats[port_id].last_clear = time(NULL);
     pthread_mutex_unlock(&priv->stats_mutex);
     
+    if (port_is_valid(port_id)) {
+        port_clear_stats(port_id);
+    }
+    
     LOG_INFO("Cleared statistics for port %u", port_id);
     return ERROR_NONE;
 }
@@ -224,27 +443,38 @@ error_code_t stats_clear_vlan(stats_context_t *ctx, vlan_id_t vlan_id) {
     stats_private_t *priv = (stats_private_t *)ctx->private_data;
     
     pthread_mutex_lock(&priv->stats_mutex);
-    memset(&priv->vlan_stats[vlan_id], 0, sizeof(vlan_stats_t));
-    priv->vlan_stats[vlan_id].last_clear = time(NULL);
+    stats_vlan_entry_t *entry = stats_vlan_get(priv, vlan_id);
+    if (entry) {
+        memset(&entry->stats, 0, sizeof(vlan_stats_t));
+        entry->stats.last_clear = time(NULL);
+    }
     pthread_mutex_unlock(&priv->stats_mutex);
     
+    storm_control_clear_vlan_counters(vlan_id);
+    vlan_clear_counters(vlan_id);
+    
     LOG_INFO("Cleared statistics for VLAN %u", vlan_id);
     return ERROR_NONE;
 }
 
 error_code_t stats_clear_queue(stats_context_t *ctx, port_id_t port_id, uint8_t queue_id) {
-    if (!ctx || !ctx->private_data || 
-        port_id >= MAX_PORTS || queue_id >= MAX_QUEUES_PER_PORT) {
+    if (!ctx || !ctx->private_data || queue_id >= MAX_QUEUES_PER_PORT) {
         return ERROR_INVALID_PARAMETER;
     }
     
     stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    if (port_id >= priv->num_ports) {
+        return ERROR_INVALID_PARAMETER;
+    }
     
     pthread_mutex_lock(&priv->stats_mutex);
-    memset(&priv->queue_stats[port_id][queue_id], 0, sizeof(queue_stats_t));
-    priv->queue_stats[port_id][queue_id].last_clear = time(NULL);
+    queue_stats_t *queue = &priv->queue_stats[port_id * MAX_QUEUES_PER_PORT + queue_id];
+    memset(queue, 0, sizeof(queue_stats_t));
+    queue->last_clear = time(NULL);
     pthread_mutex_unlock(&priv->stats_mutex);
     
+    qos_clear_queue_stats(port_id, queue_id);
+    
     LOG_INFO("Cleared statistics for queue %u on port %u", queue_id, port_id);
     return ERROR_NONE;
 }
@@ -276,20 +506,30 @@ error_code_t stats_clear_all(stats_context_t *ctx) {
     pthread_mutex_lock(&priv->stats_mutex);
     
     // Clear port and queue stats
-    for (int i = 0; i < MAX_PORTS; i++) {
+    for (uint32_t i = 0; i < priv->num_ports; i++) {
         memset(&priv->port_stats[i], 0, sizeof(port_stats_t));
         priv->port_stats[i].last_clear = current_time;
+        if (port_is_valid((port_id_t)i)) {
+            port_clear_stats((port_id_t)i);
+        }
         
         for (int j = 0; j < MAX_QUEUES_PER_PORT; j++) {
-            memset(&priv->queue_stats[i][j], 0, sizeof(queue_stats_t));
-            priv->queue_stats[i][j].last_clear = current_time;
+            queue_stats_t *queue = &priv->queue_stats[i * MAX_QUEUES_PER_PORT + j];
+            memset(queue, 0, sizeof(queue_stats_t));
+            queue->last_clear = current_time;
+            qos_clear_queue_stats((port_id_t)i, (uint8_t)j);
         }
     }
     
-    // Clear VLAN stats
-    for (int i = 0; i < MAX_VLANS; i++) {
-        memset(&priv->vlan_stats[i], 0, sizeof(vlan_stats_t));
-        priv->vlan_stats[i].last_clear = current_time;
+    // Clear VLAN stats; only active VLANs have entries and live counters
+    priv->start_time = current_time;
+    stats_vlan_sync(priv);
+    for (uint32_t i = 0; i < priv->vlan_count; i++) {
+        stats_vlan_entry_t *entry = &priv->vlans[i];
+        memset(&entry->stats, 0, sizeof(vlan_stats_t));
+        entry->stats.last_clear = current_time;
+        storm_control_clear_vlan_counters(entry->vlan_id);
+        vlan_clear_counters(entry->vlan_id);
     }
     
     // Clear routing stats
@@ -348,6 +588,67 @@ error_code_t stats_disable_periodic_collection(stats_context_t *ctx) {
     return ERROR_NONE;
 }
 
+/**
+ * @brief Get the threshold engine, creating it on first use
+ */
+static stats_threshold_engine_t *stats_get_thresholds(stats_private_t *priv) {
+    stats_threshold_engine_t *engine = __atomic_load_n(&priv->thresholds, __ATOMIC_ACQUIRE);
+    uint32_t counts[TELEMETRY_OBJ_COUNT];
+    uint32_t words[TELEMETRY_OBJ_COUNT];
+    
+    if (engine) {
+        return engine;
+    }
+    
+    pthread_mutex_lock(&priv->stats_mutex);
+    engine = priv->thresholds;
+    if (!engine) {
+        stats_record_layout(priv, counts, words);
+        if (stats_threshold_engine_create(counts, words, &engine) == STATUS_SUCCESS) {
+            __atomic_store_n(&priv->thresholds, engine, __ATOMIC_RELEASE);
+        } else {
+            engine = NULL;
+        }
+    }
+    pthread_mutex_unlock(&priv->stats_mutex);
+    
+    return engine;
+}
+
+error_code_t stats_add_threshold(stats_context_t *ctx, const stats_threshold_t *threshold,
+                                 uint32_t *id) {
+    if (!ctx || !ctx->private_data || !threshold) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    
+    stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    stats_threshold_engine_t *engine = stats_get_thresholds(priv);
+    
+    if (!engine) {
+        return ERROR_OUT_OF_MEMORY;
+    }
+    
+    status_t status = stats_threshold_add(engine, threshold, id);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    return ERROR_NONE;
+}
+
+error_code_t stats_remove_threshold(stats_context_t *ctx, uint32_t id) {
+    if (!ctx || !ctx->private_data) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    
+    stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    stats_threshold_engine_t *engine = __atomic_load_n(&priv->thresholds, __ATOMIC_ACQUIRE);
+    
+    if (!engine || stats_threshold_remove(engine, id) != STATUS_SUCCESS) {
+        return STATUS_NOT_FOUND;
+    }
+    return ERROR_NONE;
+}
+
 error_code_t stats_register_threshold_callback(stats_context_t *ctx, 
                                               const char *stat_type,
                                               uint64_t threshold,
@@ -357,30 +658,477 @@ error_code_t stats_register_threshold_callback(stats_context_t *ctx,
         return ERROR_INVALID_PARAMETER;
     }
     
+    stats_threshold_t spec;
+    
+    // The name is resolved once here, never on the collection thread
+    if (stats_threshold_parse(stat_type, MAX_QUEUES_PER_PORT, &spec) != STATUS_SUCCESS) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    spec.kind = STATS_THRESHOLD_VALUE;
+    spec.threshold = threshold;
+    spec.callback = callback;
+    spec.user_data = user_data;
+    
+    error_code_t status = stats_add_threshold(ctx, &spec, NULL);
+    if (status != ERROR_NONE) {
+        return status;
+    }
+    
+    LOG_INFO("Registered threshold callback for %s with threshold %" PRIu64, stat_type, threshold);
+    return ERROR_NONE;
+}
+
+/**
+ * @brief Read the counters of every existing object of the given types
+ *
+ * @param ctx Statistics context
+ * @param objects TELEMETRY_SUBSCRIBE() bits of the types to read
+ * @param active Output set of active VLANs, VLAN_ID_WORDS words
+ * @param fn Called once per object
+ * @param arg Passed to fn
+ */
+static void stats_gather(stats_context_t *ctx, uint32_t objects, uint64_t *active,
+                         stats_record_fn_t fn, void *arg) {
     stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    port_stats_t port;
+    vlan_stats_t vlan;
+    queue_stats_t queue;
+    routing_stats_t routing;
+    
+    for (uint32_t i = 0; i < priv->num_ports; i++) {
+        if ((objects & TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_PORT)) &&
+            stats_get_port(ctx, (port_id_t)i, &port) == ERROR_NONE) {
+            stats_export_port_t rec = {
+                .rx_packets = port.rx_packets,
+                .tx_packets = port.tx_packets,
+                .rx_bytes = port.rx_bytes,
+                .tx_bytes = port.tx_bytes,
+                .rx_errors = port.rx_errors,
+                .tx_errors = port.tx_errors,
+                .rx_drops = port.rx_drops,
+                .tx_drops = port.tx_drops,
+                .rx_unicast = port.rx_unicast,
+                .tx_unicast = port.tx_unicast,
+                .rx_broadcast = port.rx_broadcast,
+                .tx_broadcast = port.tx_broadcast,
+                .rx_multicast = port.rx_multicast,
+                .tx_multicast = port.tx_multicast,
+                .collisions = port.collisions,
+                .last_clear = (uint64_t)port.last_clear,
+            };
+            fn(arg, TELEMETRY_OBJ_PORT, i, (const uint64_t *)&rec);
+        }
+        
+        if (!(objects & TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_QUEUE))) {
+            continue;
+        }
+        for (uint32_t q = 0; q < MAX_QUEUES_PER_PORT; q++) {
+            if (stats_get_queue(ctx, (port_id_t)i, (uint8_t)q, &queue) != ERROR_NONE) {
+                continue;
+            }
+            stats_export_queue_t rec = {
+                .enqueued = queue.enqueued,
+                .dequeued = queue.dequeued,
+                .dropped = queue.dropped,
+                .current_depth = queue.current_depth,
+                .max_depth = queue.max_depth,
+                .last_clear = (uint64_t)queue.last_clear,
+            };
+            fn(arg, TELEMETRY_OBJ_QUEUE, i * MAX_QUEUES_PER_PORT + q, (const uint64_t *)&rec);
+        }
+    }
     
+    // Only active VLANs are read
     pthread_mutex_lock(&priv->stats_mutex);
+    stats_vlan_sync(priv);
+    memcpy(active, priv->vlan_present, VLAN_ID_WORDS * sizeof(uint64_t));
+    pthread_mutex_unlock(&priv->stats_mutex);
+    
+    if (objects & TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_VLAN)) {
+        BITMAP_FOR_EACH(vlan_id, active, VLAN_ID_WORDS) {
+            if (stats_get_vlan(ctx, (vlan_id_t)vlan_id, &vlan) != ERROR_NONE) {
+                continue;
+            }
+            stats_export_vlan_t rec = {
+                .rx_packets = vlan.rx_packets,
+                .tx_packets = vlan.tx_packets,
+                .rx_bytes = vlan.rx_bytes,
+                .tx_bytes = vlan.tx_bytes,
+                .storm_dropped_packets = vlan.storm_dropped_packets,
+                .storm_dropped_bytes = vlan.storm_dropped_bytes,
+                .last_clear = (uint64_t)vlan.last_clear,
+            };
+            fn(arg, TELEMETRY_OBJ_VLAN, vlan_id, (const uint64_t *)&rec);
+        }
+    }
     
-    // Check if we have space for another callback
-    if (priv->callback_count >= MAX_CALLBACKS) {
-        pthread_mutex_unlock(&priv->stats_mutex);
-        return ERROR_RESOURCE_EXHAUSTED;
+    if ((objects & TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_ROUTING)) &&
+        stats_get_routing(ctx, &routing) == ERROR_NONE) {
+        stats_export_routing_t rec = {
+            .routed_packets = routing.routed_packets,
+            .routed_bytes = routing.routed_bytes,
+            .routing_failures = routing.routing_failures,
+            .arp_requests = routing.arp_requests,
+            .arp_replies = routing.arp_replies,
+            .last_clear = (uint64_t)routing.last_clear,
+        };
+        fn(arg, TELEMETRY_OBJ_ROUTING, 0, (const uint64_t *)&rec);
     }
     
-    // Add the callback
-    threshold_callback_t *cb = &priv->callbacks[priv->callback_count];
-    strncpy(cb->stat_type, stat_type, sizeof(cb->stat_type) - 1);
-    cb->stat_type[sizeof(cb->stat_type) - 1] = '\0';
-    cb->threshold = threshold;
-    cb->callback = callback;
-    cb->user_data = user_data;
-    cb->active = true;
+    // Only slots the INT sink ports have claimed for a hop
+    if (objects & TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_INT)) {
+        int_telemetry_hop_stats_t hop;
+        
+        for (uint32_t slot = 0; slot < CONFIG_INT_SINK_SLOTS; slot++) {
+            if (int_telemetry_get_hop(slot, &hop) != STATUS_SUCCESS) {
+                continue;
+            }
+            stats_export_int_t rec = {
+                .switch_id = hop.switch_id,
+                .egress_port = hop.egress_port,
+                .packets = hop.packets,
+                .latency_total_ns = hop.latency_total_ns,
+                .latency_max_ns = hop.latency_max_ns,
+                .depth_total = hop.depth_total,
+                .depth_max = hop.depth_max,
+            };
+            fn(arg, TELEMETRY_OBJ_INT, slot, (const uint64_t *)&rec);
+        }
+    }
+}
+
+/**
+ * @brief stats_gather() sink that stages records in the shared-memory segment
+ */
+static void stats_export_sink(void *arg, telemetry_object_t obj, uint32_t index,
+                              const uint64_t *counters) {
+    stats_export_t *exp = (stats_export_t *)arg;
     
-    priv->callback_count++;
+    switch (obj) {
+        case TELEMETRY_OBJ_PORT:
+            memcpy(stats_export_port(exp, index), counters, sizeof(stats_export_port_t));
+            break;
+        case TELEMETRY_OBJ_VLAN:
+            memcpy(stats_export_vlan(exp, index), counters, sizeof(stats_export_vlan_t));
+            break;
+        case TELEMETRY_OBJ_QUEUE:
+            memcpy(stats_export_queue(exp, index), counters, sizeof(stats_export_queue_t));
+            break;
+        case TELEMETRY_OBJ_ROUTING:
+            memcpy(stats_export_routing(exp), counters, sizeof(stats_export_routing_t));
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Gather all counters into the export staging area and publish them
+ *
+ * Runs on the collection thread; does nothing unless export is enabled.
+ */
+static void stats_publish_export(stats_context_t *ctx) {
+    stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    uint64_t active[VLAN_ID_WORDS];
+    uint64_t gone[VLAN_ID_WORDS];
+    stats_export_t *exp;
     
-    pthread_mutex_unlock(&priv->stats_mutex);
+    pthread_mutex_lock(&priv->export_mutex);
+    exp = priv->export;
+    if (!exp) {
+        pthread_mutex_unlock(&priv->export_mutex);
+        return;
+    }
     
-    LOG_INFO("Registered threshold callback for %s with threshold %" PRIu64, stat_type, threshold);
+    // The segment has no room for INT hops
+    stats_gather(ctx, TELEMETRY_SUBSCRIBE_ALL & ~TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_INT), active,
+                 stats_export_sink, exp);
+    
+    // Records of deleted VLANs are zeroed once
+    bitmap_andnot(gone, priv->exported_vlans, active, VLAN_ID_WORDS);
+    BITMAP_FOR_EACH(vlan_id, gone, VLAN_ID_WORDS) {
+        memset(stats_export_vlan(exp, vlan_id), 0, sizeof(stats_export_vlan_t));
+    }
+    bitmap_copy(priv->exported_vlans, active, VLAN_ID_WORDS);
+    
+    stats_export_publish(exp);
+    pthread_mutex_unlock(&priv->export_mutex);
+}
+
+/**
+ * @brief stats_gather() sink that feeds the telemetry exporter
+ */
+static void stats_telemetry_sink(void *arg, telemetry_object_t obj, uint32_t index,
+                                 const uint64_t *counters) {
+    telemetry_record((telemetry_t *)arg, obj, index, counters);
+}
+
+/**
+ * @brief Telemetry thread: push changed counters at the configured cadence
+ */
+static void *stats_telemetry_thread(void *arg) {
+    stats_context_t *ctx = (stats_context_t *)arg;
+    stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    telemetry_t *tel = priv->telemetry;
+    uint64_t interval_ns = (uint64_t)telemetry_interval_ms(tel) * 1000000ULL;
+    uint32_t objects = 0;
+    uint64_t active[VLAN_ID_WORDS];
+    struct timespec next;
+    
+    for (int i = 0; i < TELEMETRY_OBJ_COUNT; i++) {
+        if (telemetry_subscribed(tel, (telemetry_object_t)i)) {
+            objects |= TELEMETRY_SUBSCRIBE(i);
+        }
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (__atomic_load_n(&priv->telemetry_active, __ATOMIC_ACQUIRE)) {
+        telemetry_begin(tel);
+        stats_gather(ctx, objects, active, stats_telemetry_sink, tel);
+        telemetry_end(tel);
+        
+        // Fixed cadence: the next push is due one interval after the last was due
+        uint64_t ns = (uint64_t)next.tv_nsec + interval_ns;
+        next.tv_sec += (time_t)(ns / 1000000000ULL);
+        next.tv_nsec = (long)(ns % 1000000000ULL);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    
+    return NULL;
+}
+
+error_code_t stats_enable_telemetry(stats_context_t *ctx, const telemetry_config_t *config) {
+    if (!ctx || !ctx->private_data || !config) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    
+    stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    uint32_t counts[TELEMETRY_OBJ_COUNT];
+    uint32_t words[TELEMETRY_OBJ_COUNT];
+    status_t status;
+    
+    stats_disable_telemetry(ctx);
+    
+    stats_record_layout(priv, counts, words);
+    
+    status = telemetry_create(config, counts, words, &priv->telemetry);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    
+    priv->telemetry_active = true;
+    if (pthread_create(&priv->telemetry_thread, NULL, stats_telemetry_thread, ctx) != 0) {
+        priv->telemetry_active = false;
+        telemetry_destroy(priv->telemetry);
+        priv->telemetry = NULL;
+        return ERROR_INTERNAL;
+    }
+    
+    LOG_INFO("Enabled streaming telemetry every %u ms", config->interval_ms);
+    return ERROR_NONE;
+}
+
+error_code_t stats_disable_telemetry(stats_context_t *ctx) {
+    if (!ctx || !ctx->private_data) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    
+    stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    
+    if (priv->telemetry) {
+        __atomic_store_n(&priv->telemetry_active, false, __ATOMIC_RELEASE);
+        pthread_join(priv->telemetry_thread, NULL);
+        telemetry_destroy(priv->telemetry);
+        priv->telemetry = NULL;
+        
+        LOG_INFO("Disabled streaming telemetry");
+    }
+    
+    return ERROR_NONE;
+}
+
+/**
+ * @brief History thread: take a sample of the chosen counters at the configured cadence
+ */
+static void *stats_history_thread(void *arg) {
+    stats_context_t *ctx = (stats_context_t *)arg;
+    stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    stats_history_t *hist = priv->history;
+    uint64_t interval_ns = (uint64_t)stats_history_header(hist)->interval_ms * 1000000ULL;
+    uint32_t objects = stats_history_objects(hist);
+    uint64_t active[VLAN_ID_WORDS];
+    port_config_t config;
+    struct timespec next;
+    
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (__atomic_load_n(&priv->history_active, __ATOMIC_ACQUIRE)) {
+        stats_history_begin(hist);
+        stats_gather(ctx, objects, active, stats_history_record, hist);
+        if (objects & TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_PORT)) {
+            // Utilization follows speed changes from one sample to the next
+            for (uint32_t i = 0; i < priv->num_ports; i++) {
+                uint64_t speed = 0;
+                if (port_is_valid((port_id_t)i) && port_get_config((port_id_t)i, &config) == STATUS_SUCCESS) {
+                    speed = (uint64_t)config.speed;
+                }
+                stats_history_set_port_speed(hist, i, speed);
+            }
+        }
+        stats_history_end(hist);
+        
+        // Fixed cadence: the next sample is due one interval after the last was due
+        uint64_t ns = (uint64_t)next.tv_nsec + interval_ns;
+        next.tv_sec += (time_t)(ns / 1000000000ULL);
+        next.tv_nsec = (long)(ns % 1000000000ULL);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    
+    return NULL;
+}
+
+error_code_t stats_enable_history(stats_context_t *ctx, const stats_history_config_t *config) {
+    if (!ctx || !ctx->private_data || !config) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    
+    stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    uint32_t counts[TELEMETRY_OBJ_COUNT];
+    uint32_t words[TELEMETRY_OBJ_COUNT];
+    stats_history_t *hist;
+    status_t status;
+    
+    stats_disable_history(ctx);
+    
+    stats_record_layout(priv, counts, words);
+    
+    status = stats_history_create(config, counts, words, &hist);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    
+    pthread_mutex_lock(&priv->history_mutex);
+    priv->history = hist;
+    pthread_mutex_unlock(&priv->history_mutex);
+    
+    priv->history_active = true;
+    if (pthread_create(&priv->history_thread, NULL, stats_history_thread, ctx) != 0) {
+        priv->history_active = false;
+        pthread_mutex_lock(&priv->history_mutex);
+        priv->history = NULL;
+        pthread_mutex_unlock(&priv->history_mutex);
+        stats_history_destroy(hist);
+        return ERROR_INTERNAL;
+    }
+    
+    LOG_INFO("Enabled counter history every %u ms", config->interval_ms);
+    return ERROR_NONE;
+}
+
+error_code_t stats_disable_history(stats_context_t *ctx) {
+    if (!ctx || !ctx->private_data) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    
+    stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    
+    if (priv->history) {
+        __atomic_store_n(&priv->history_active, false, __ATOMIC_RELEASE);
+        pthread_join(priv->history_thread, NULL);
+        
+        pthread_mutex_lock(&priv->history_mutex);
+        stats_history_t *hist = priv->history;
+        priv->history = NULL;
+        pthread_mutex_unlock(&priv->history_mutex);
+        stats_history_destroy(hist);
+        
+        LOG_INFO("Disabled counter history");
+    }
+    
+    return ERROR_NONE;
+}
+
+error_code_t stats_get_port_utilization(stats_context_t *ctx, port_id_t port_id,
+                                        stats_history_utilization_t *util) {
+    if (!ctx || !ctx->private_data || !util) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    
+    stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    status_t status = STATUS_NOT_INITIALIZED;
+    
+    pthread_mutex_lock(&priv->history_mutex);
+    if (priv->history) {
+        status = stats_history_port_utilization(stats_history_header(priv->history), port_id, util);
+    }
+    pthread_mutex_unlock(&priv->history_mutex);
+    
+    return status;
+}
+
+error_code_t stats_get_counter_history(stats_context_t *ctx, telemetry_object_t obj, uint32_t index,
+                                       uint32_t counter, uint64_t *values, uint64_t *times_ns,
+                                       uint32_t max, uint32_t *count) {
+    if (!ctx || !ctx->private_data) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    
+    stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    status_t status = STATUS_NOT_INITIALIZED;
+    
+    pthread_mutex_lock(&priv->history_mutex);
+    if (priv->history) {
+        status = stats_history_get_series(stats_history_header(priv->history), obj, index, counter,
+                                          values, times_ns, max, count);
+    }
+    pthread_mutex_unlock(&priv->history_mutex);
+    
+    return status;
+}
+
+error_code_t stats_enable_shm_export(stats_context_t *ctx, const char *name) {
+    if (!ctx || !ctx->private_data) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    
+    stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    stats_export_t *exp;
+    status_t status;
+    
+    status = stats_export_create(name, priv->num_ports, MAX_VLANS, MAX_QUEUES_PER_PORT, &exp);
+    if (status != STATUS_SUCCESS) {
+        return status;
+    }
+    
+    pthread_mutex_lock(&priv->export_mutex);
+    stats_export_t *old = priv->export;
+    priv->export = exp;
+    memset(priv->exported_vlans, 0, sizeof(priv->exported_vlans));
+    pthread_mutex_unlock(&priv->export_mutex);
+    stats_export_destroy(old);
+    
+    // Readers get a first snapshot without waiting for the collection thread
+    stats_publish_export(ctx);
+    
+    LOG_INFO("Enabled shared-memory statistics export");
+    return ERROR_NONE;
+}
+
+error_code_t stats_disable_shm_export(stats_context_t *ctx) {
+    if (!ctx || !ctx->private_data) {
+        return ERROR_INVALID_PARAMETER;
+    }
+    
+    stats_private_t *priv = (stats_private_t *)ctx->private_data;
+    
+    pthread_mutex_lock(&priv->export_mutex);
+    stats_export_t *exp = priv->export;
+    priv->export = NULL;
+    pthread_mutex_unlock(&priv->export_mutex);
+    
+    if (exp) {
+        stats_export_destroy(exp);
+        LOG_INFO("Disabled shared-memory statistics export");
+    }
     return ERROR_NONE;
 }
 
@@ -395,11 +1143,20 @@ error_code_t stats_deinitialize (stats_context_t *ctx) {
     if (priv->collection_active) {
         stats_disable_periodic_collection(ctx);
     }
+    stats_disable_shm_export(ctx);
+    stats_disable_telemetry(ctx);
+    stats_disable_history(ctx);
+    stats_threshold_engine_destroy(priv->thresholds);
     
     // Destroy mutex
     pthread_mutex_destroy(&priv->stats_mutex);
+    pthread_mutex_destroy(&priv->export_mutex);
+    pthread_mutex_destroy(&priv->history_mutex);
     
     // Free private data
+    free(priv->port_stats);
+    free(priv->queue_stats);
+    free(priv->vlans);
     free(priv);
     ctx->private_data = NULL;
     
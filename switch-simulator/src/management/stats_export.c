@@ -0,0 +1,188 @@
+/**
+ * @file stats_export.c
+ * @brief Shared-memory statistics segment for external readers
+ *
+ * The writer keeps a private staging copy of the records so that
+ * gathering counters, which takes module locks, happens outside the
+ * sequence lock. Publishing is a single copy of the staging area into
+ * the segment.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../../include/management/stats_export.h"
+#include "../../include/common/logging.h"
+
+#define STATS_EXPORT_NAME_MAX 64
+
+/**
+ * @brief Writer side of a segment
+ */
+struct stats_export {
+    char name[STATS_EXPORT_NAME_MAX];
+    stats_export_header_t *hdr;         /* Mapped segment */
+    size_t size;                        /* Bytes mapped */
+    uint8_t *staging;                   /* Next update of the records */
+    size_t records_size;                /* Bytes from port_offset to the end */
+};
+
+/**
+ * @brief Round up to a cache line
+ */
+static size_t stats_export_align(size_t size) {
+    return (size + 63) & ~(size_t)63;
+}
+
+status_t stats_export_create(const char *name, uint32_t port_count, uint32_t vlan_count,
+                             uint32_t queues_per_port, stats_export_t **exp) {
+    stats_export_header_t layout;
+    stats_export_t *new_exp;
+    size_t offset;
+    void *map;
+    int fd;
+
+    if (!exp || port_count == 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (!name) {
+        name = STATS_EXPORT_DEFAULT_NAME;
+    }
+    if (name[0] != '/' || strlen(name) >= STATS_EXPORT_NAME_MAX) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(&layout, 0, sizeof(layout));
+    layout.magic = STATS_EXPORT_MAGIC;
+    layout.version_major = STATS_EXPORT_VERSION_MAJOR;
+    layout.version_minor = STATS_EXPORT_VERSION_MINOR;
+    layout.header_size = sizeof(stats_export_header_t);
+    layout.writer_pid = (uint32_t)getpid();
+    layout.port_count = port_count;
+    layout.vlan_count = vlan_count;
+    layout.queues_per_port = queues_per_port;
+    layout.port_record_size = sizeof(stats_export_port_t);
+    layout.vlan_record_size = sizeof(stats_export_vlan_t);
+    layout.queue_record_size = sizeof(stats_export_queue_t);
+    layout.routing_record_size = sizeof(stats_export_routing_t);
+
+    // Each table starts on its own cache line
+    offset = stats_export_align(sizeof(stats_export_header_t));
+    layout.port_offset = (uint32_t)offset;
+    offset = stats_export_align(offset + (size_t)port_count * sizeof(stats_export_port_t));
+    layout.vlan_offset = (uint32_t)offset;
+    offset = stats_export_align(offset + (size_t)vlan_count * sizeof(stats_export_vlan_t));
+    layout.queue_offset = (uint32_t)offset;
+    offset = stats_export_align(offset + (size_t)port_count * queues_per_port * sizeof(stats_export_queue_t));
+    layout.routing_offset = (uint32_t)offset;
+    offset = stats_export_align(offset + sizeof(stats_export_routing_t));
+    layout.total_size = offset;
+
+    new_exp = (stats_export_t *)calloc(1, sizeof(*new_exp));
+    if (!new_exp) {
+        return STATUS_NO_MEMORY;
+    }
+    strcpy(new_exp->name, name);
+    new_exp->size = offset;
+    new_exp->records_size = offset - layout.port_offset;
+    new_exp->staging = (uint8_t *)calloc(1, new_exp->records_size);
+    if (!new_exp->staging) {
+        free(new_exp);
+        return STATUS_NO_MEMORY;
+    }
+
+    // A stale segment from an earlier run may have another layout
+    shm_unlink(name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Stats export: shm_open(%s) failed: %s", name, strerror(errno));
+        free(new_exp->staging);
+        free(new_exp);
+        return STATUS_FAILURE;
+    }
+    if (ftruncate(fd, (off_t)new_exp->size) != 0) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Stats export: failed to size %s: %s", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        free(new_exp->staging);
+        free(new_exp);
+        return STATUS_FAILURE;
+    }
+    map = mmap(NULL, new_exp->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Stats export: failed to map %s: %s", name, strerror(errno));
+        shm_unlink(name);
+        free(new_exp->staging);
+        free(new_exp);
+        return STATUS_FAILURE;
+    }
+
+    // The new file is zero filled; an even sequence of 0 means no update yet
+    new_exp->hdr = (stats_export_header_t *)map;
+    memcpy(new_exp->hdr, &layout, sizeof(layout));
+
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Stats export: publishing %zu bytes in %s", new_exp->size, name);
+    *exp = new_exp;
+    return STATUS_SUCCESS;
+}
+
+void stats_export_destroy(stats_export_t *exp) {
+    if (!exp) {
+        return;
+    }
+
+    munmap(exp->hdr, exp->size);
+    shm_unlink(exp->name);
+    free(exp->staging);
+    free(exp);
+}
+
+stats_export_port_t *stats_export_port(stats_export_t *exp, uint32_t index) {
+    if (index >= exp->hdr->port_count) {
+        return NULL;
+    }
+    return (stats_export_port_t *)exp->staging + index;
+}
+
+stats_export_vlan_t *stats_export_vlan(stats_export_t *exp, uint32_t index) {
+    if (index >= exp->hdr->vlan_count) {
+        return NULL;
+    }
+    return (stats_export_vlan_t *)(exp->staging + (exp->hdr->vlan_offset - exp->hdr->port_offset)) + index;
+}
+
+stats_export_queue_t *stats_export_queue(stats_export_t *exp, uint32_t index) {
+    if (index >= exp->hdr->port_count * exp->hdr->queues_per_port) {
+        return NULL;
+    }
+    return (stats_export_queue_t *)(exp->staging + (exp->hdr->queue_offset - exp->hdr->port_offset)) + index;
+}
+
+stats_export_routing_t *stats_export_routing(stats_export_t *exp) {
+    return (stats_export_routing_t *)(exp->staging + (exp->hdr->routing_offset - exp->hdr->port_offset));
+}
+
+void stats_export_publish(stats_export_t *exp) {
+    stats_export_header_t *hdr = exp->hdr;
+    uint64_t seq = hdr->sequence;
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    // Odd sequence first, so no reader trusts a copy that overlaps the update
+    __atomic_store_n(&hdr->sequence, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy((uint8_t *)hdr + hdr->port_offset, exp->staging, exp->records_size);
+    hdr->update_time_ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+    hdr->update_count++;
+
+    __atomic_store_n(&hdr->sequence, seq + 2, __ATOMIC_RELEASE);
+}
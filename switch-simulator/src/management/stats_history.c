@@ -0,0 +1,428 @@
+/**
+ * @file stats_history.c
+ * @brief Counter time series with rates, in shared memory
+ *
+ * Samples are written straight into the spare slot of the ring, which
+ * no reader looks at, so gathering counters happens outside the
+ * sequence lock. Rates are kept in a private staging copy, because the
+ * moving average and the peak carry over from one sample to the next,
+ * and copied into the segment when the sample is published.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../../include/management/stats_history.h"
+#include "../../include/common/bitmap.h"
+#include "../../include/common/logging.h"
+
+#define STATS_HISTORY_NAME_MAX 64
+
+/* Counter numbers of the byte counters in stats_export_port_t */
+#define STATS_HISTORY_PORT_RX_BYTES 2
+#define STATS_HISTORY_PORT_TX_BYTES 3
+
+/**
+ * @brief Writer side of a history
+ */
+struct stats_history {
+    char name[STATS_HISTORY_NAME_MAX];  /* Empty for private memory */
+    stats_history_header_t *hdr;        /* Mapped segment */
+    size_t size;                        /* Bytes mapped */
+    uint32_t objects;                   /* TELEMETRY_SUBSCRIBE() bits */
+    double ewma_weight;                 /* ewma_pct / 100 */
+    stats_history_rate_t *rates[TELEMETRY_OBJ_COUNT]; /* Staging copy of the rate tables */
+    uint64_t *seen[TELEMETRY_OBJ_COUNT];  /* Objects recorded in the sample being taken */
+    uint32_t next;                      /* Slot being filled */
+    uint64_t now_ns;                    /* CLOCK_REALTIME of the sample being taken */
+};
+
+static size_t stats_history_align(size_t size) {
+    return (size + 63) & ~(size_t)63;
+}
+
+static uint64_t *stats_history_slot(const stats_history_header_t *hdr, telemetry_object_t obj,
+                                    uint32_t index, uint32_t slot) {
+    return (uint64_t *)((uint8_t *)hdr + hdr->sample_offset[obj]) +
+           ((size_t)index * hdr->slots + slot) * hdr->words[obj];
+}
+
+status_t stats_history_create(const stats_history_config_t *config,
+                              const uint32_t counts[TELEMETRY_OBJ_COUNT],
+                              const uint32_t words[TELEMETRY_OBJ_COUNT],
+                              stats_history_t **hist) {
+    stats_history_header_t layout;
+    stats_history_t *new_hist;
+    size_t offset;
+    void *map;
+
+    if (!config || !counts || !words || !hist || config->interval_ms == 0 ||
+        (config->objects & TELEMETRY_SUBSCRIBE_ALL) == 0 || config->ewma_pct > 100) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (config->name && (config->name[0] != '/' || strlen(config->name) >= STATS_HISTORY_NAME_MAX)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    memset(&layout, 0, sizeof(layout));
+    layout.magic = STATS_HISTORY_MAGIC;
+    layout.version_major = STATS_HISTORY_VERSION_MAJOR;
+    layout.version_minor = STATS_HISTORY_VERSION_MINOR;
+    layout.header_size = sizeof(stats_history_header_t);
+    layout.writer_pid = (uint32_t)getpid();
+    layout.interval_ms = config->interval_ms;
+    layout.depth = config->depth ? config->depth : STATS_HISTORY_DEFAULT_DEPTH;
+    layout.slots = layout.depth + 1;
+    layout.ewma_pct = config->ewma_pct ? config->ewma_pct : STATS_HISTORY_DEFAULT_EWMA_PCT;
+    for (int t = 0; t < TELEMETRY_OBJ_COUNT; t++) {
+        if (config->objects & TELEMETRY_SUBSCRIBE(t)) {
+            layout.count[t] = counts[t];
+            layout.words[t] = words[t];
+        }
+    }
+
+    // Each table starts on its own cache line
+    offset = stats_history_align(sizeof(stats_history_header_t));
+    layout.time_offset = (uint32_t)offset;
+    offset = stats_history_align(offset + (size_t)layout.slots * sizeof(uint64_t));
+    layout.speed_offset = (uint32_t)offset;
+    offset = stats_history_align(offset + (size_t)layout.count[TELEMETRY_OBJ_PORT] * sizeof(uint64_t));
+    for (int t = 0; t < TELEMETRY_OBJ_COUNT; t++) {
+        layout.sample_offset[t] = (uint32_t)offset;
+        offset = stats_history_align(offset + (size_t)layout.count[t] * layout.slots *
+                                     layout.words[t] * sizeof(uint64_t));
+        layout.rate_offset[t] = (uint32_t)offset;
+        offset = stats_history_align(offset + (size_t)layout.count[t] * layout.words[t] *
+                                     sizeof(stats_history_rate_t));
+    }
+    if (offset > UINT32_MAX) {
+        // Offsets are 32 bits; fewer samples or object types are needed
+        return STATUS_INVALID_PARAMETER;
+    }
+    layout.total_size = offset;
+
+    new_hist = (stats_history_t *)calloc(1, sizeof(*new_hist));
+    if (!new_hist) {
+        return STATUS_NO_MEMORY;
+    }
+    new_hist->size = offset;
+    new_hist->objects = config->objects & TELEMETRY_SUBSCRIBE_ALL;
+    new_hist->ewma_weight = layout.ewma_pct / 100.0;
+    for (int t = 0; t < TELEMETRY_OBJ_COUNT; t++) {
+        if (layout.count[t] == 0) {
+            continue;
+        }
+        new_hist->rates[t] = (stats_history_rate_t *)calloc((size_t)layout.count[t] * layout.words[t],
+                                                            sizeof(stats_history_rate_t));
+        new_hist->seen[t] = (uint64_t *)calloc(BITMAP_WORDS(layout.count[t]), sizeof(uint64_t));
+        if (!new_hist->rates[t] || !new_hist->seen[t]) {
+            stats_history_destroy(new_hist);
+            return STATUS_NO_MEMORY;
+        }
+    }
+
+    if (config->name) {
+        int fd;
+
+        // A stale segment from an earlier run may have another layout
+        shm_unlink(config->name);
+        fd = shm_open(config->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Stats history: shm_open(%s) failed: %s", config->name, strerror(errno));
+            stats_history_destroy(new_hist);
+            return STATUS_FAILURE;
+        }
+        strcpy(new_hist->name, config->name);
+        if (ftruncate(fd, (off_t)new_hist->size) != 0) {
+            LOG_ERROR(LOG_CATEGORY_SYSTEM, "Stats history: failed to size %s: %s", config->name, strerror(errno));
+            close(fd);
+            stats_history_destroy(new_hist);
+            return STATUS_FAILURE;
+        }
+        map = mmap(NULL, new_hist->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    } else {
+        map = mmap(NULL, new_hist->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (map == MAP_FAILED) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Stats history: failed to map %zu bytes: %s", new_hist->size, strerror(errno));
+        stats_history_destroy(new_hist);
+        return STATUS_FAILURE;
+    }
+
+    // The mapping is zero filled; head 0 with no samples is a valid empty ring
+    new_hist->hdr = (stats_history_header_t *)map;
+    memcpy(new_hist->hdr, &layout, sizeof(layout));
+
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Stats history: %u samples every %u ms in %zu bytes%s%s",
+             layout.depth, layout.interval_ms, new_hist->size,
+             config->name ? " of " : "", config->name ? config->name : "");
+    *hist = new_hist;
+    return STATUS_SUCCESS;
+}
+
+void stats_history_destroy(stats_history_t *hist) {
+    if (!hist) {
+        return;
+    }
+
+    if (hist->hdr) {
+        munmap(hist->hdr, hist->size);
+    }
+    if (hist->name[0]) {
+        shm_unlink(hist->name);
+    }
+    for (int t = 0; t < TELEMETRY_OBJ_COUNT; t++) {
+        free(hist->rates[t]);
+        free(hist->seen[t]);
+    }
+    free(hist);
+}
+
+uint32_t stats_history_objects(const stats_history_t *hist) {
+    return hist->objects;
+}
+
+const stats_history_header_t *stats_history_header(const stats_history_t *hist) {
+    return hist->hdr;
+}
+
+void stats_history_begin(stats_history_t *hist) {
+    const stats_history_header_t *hdr = hist->hdr;
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    hist->now_ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+    hist->next = (hdr->head + 1) % hdr->slots;
+    for (int t = 0; t < TELEMETRY_OBJ_COUNT; t++) {
+        if (hist->seen[t]) {
+            memset(hist->seen[t], 0, BITMAP_WORDS(hdr->count[t]) * sizeof(uint64_t));
+        }
+    }
+}
+
+/**
+ * @brief Fold the rate of one interval into the rates of a counter
+ */
+static void stats_history_update_rate(stats_history_t *hist, stats_history_rate_t *rate,
+                                      double value, bool first) {
+    rate->rate = value;
+    if (first) {
+        rate->ewma = value;
+    } else {
+        rate->ewma += hist->ewma_weight * (value - rate->ewma);
+    }
+    if (value > rate->peak) {
+        rate->peak = value;
+    }
+}
+
+void stats_history_record(void *arg, telemetry_object_t obj, uint32_t index,
+                          const uint64_t *counters) {
+    stats_history_t *hist = (stats_history_t *)arg;
+    const stats_history_header_t *hdr = hist->hdr;
+    uint32_t words;
+    uint64_t *dst;
+
+    if ((unsigned)obj >= TELEMETRY_OBJ_COUNT || index >= hdr->count[obj]) {
+        return;
+    }
+
+    words = hdr->words[obj];
+    dst = stats_history_slot(hdr, obj, index, hist->next);
+    memcpy(dst, counters, words * sizeof(uint64_t));
+    bitmap_set(hist->seen[obj], index);
+
+    if (hdr->samples == 0) {
+        return;
+    }
+
+    const uint64_t *prev = stats_history_slot(hdr, obj, index, hdr->head);
+    const uint64_t *times = (const uint64_t *)((const uint8_t *)hdr + hdr->time_offset);
+    uint64_t elapsed_ns = hist->now_ns - times[hdr->head];
+    stats_history_rate_t *rates = hist->rates[obj] + (size_t)index * words;
+    bool first = hdr->samples == 1;
+
+    if (hist->now_ns <= times[hdr->head]) {
+        // The wall clock stepped back; keep the rates of the last interval
+        return;
+    }
+    for (uint32_t c = 0; c < words; c++) {
+        double rate = 0;
+
+        if (counters[c] >= prev[c]) {
+            rate = (double)(counters[c] - prev[c]) * 1e9 / (double)elapsed_ns;
+        }
+        stats_history_update_rate(hist, &rates[c], rate, first);
+    }
+}
+
+void stats_history_set_port_speed(stats_history_t *hist, uint32_t port, uint64_t speed_mbps) {
+    stats_history_header_t *hdr = hist->hdr;
+    uint64_t *speeds = (uint64_t *)((uint8_t *)hdr + hdr->speed_offset);
+
+    if (port < hdr->count[TELEMETRY_OBJ_PORT]) {
+        __atomic_store_n(&speeds[port], speed_mbps, __ATOMIC_RELAXED);
+    }
+}
+
+void stats_history_end(stats_history_t *hist) {
+    stats_history_header_t *hdr = hist->hdr;
+    uint64_t *times = (uint64_t *)((uint8_t *)hdr + hdr->time_offset);
+    uint64_t seq = hdr->sequence;
+
+    // Objects missing from this round repeat their last sample at a rate of 0
+    for (int t = 0; t < TELEMETRY_OBJ_COUNT; t++) {
+        uint32_t words = hdr->words[t];
+
+        for (uint32_t i = 0; i < hdr->count[t]; i++) {
+            if (bitmap_test(hist->seen[t], i)) {
+                continue;
+            }
+            uint64_t *dst = stats_history_slot(hdr, (telemetry_object_t)t, i, hist->next);
+            if (hdr->samples > 0) {
+                memcpy(dst, stats_history_slot(hdr, (telemetry_object_t)t, i, hdr->head),
+                       words * sizeof(uint64_t));
+                for (uint32_t c = 0; c < words; c++) {
+                    stats_history_update_rate(hist, &hist->rates[t][(size_t)i * words + c], 0,
+                                              hdr->samples == 1);
+                }
+            } else {
+                memset(dst, 0, words * sizeof(uint64_t));
+            }
+        }
+    }
+
+    // Odd sequence first, so no reader trusts a copy that overlaps the update
+    __atomic_store_n(&hdr->sequence, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    for (int t = 0; t < TELEMETRY_OBJ_COUNT; t++) {
+        if (hdr->count[t]) {
+            memcpy((uint8_t *)hdr + hdr->rate_offset[t], hist->rates[t],
+                   (size_t)hdr->count[t] * hdr->words[t] * sizeof(stats_history_rate_t));
+        }
+    }
+    times[hist->next] = hist->now_ns;
+    hdr->head = hist->next;
+    if (hdr->samples < hdr->depth) {
+        hdr->samples++;
+    }
+    hdr->update_time_ns = hist->now_ns;
+    hdr->update_count++;
+
+    __atomic_store_n(&hdr->sequence, seq + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Check that a counter of an object is sampled
+ */
+static bool stats_history_valid(const stats_history_header_t *hdr, telemetry_object_t obj,
+                                uint32_t index) {
+    return hdr && (unsigned)obj < TELEMETRY_OBJ_COUNT && index < hdr->count[obj];
+}
+
+status_t stats_history_get_rate(const stats_history_header_t *hdr, telemetry_object_t obj,
+                                uint32_t index, uint32_t counter, stats_history_rate_t *rate) {
+    if (!rate || !stats_history_valid(hdr, obj, index) || counter >= hdr->words[obj]) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    size_t offset = hdr->rate_offset[obj] +
+                    ((size_t)index * hdr->words[obj] + counter) * sizeof(stats_history_rate_t);
+    return stats_history_read(hdr, offset, sizeof(*rate), rate, NULL, NULL) ?
+           STATUS_SUCCESS : STATUS_INVALID_PARAMETER;
+}
+
+status_t stats_history_get_rates(const stats_history_header_t *hdr, telemetry_object_t obj,
+                                 uint32_t index, stats_history_rate_t *rates, uint32_t max,
+                                 uint32_t *count) {
+    if (!rates || !count || !stats_history_valid(hdr, obj, index)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    uint32_t n = hdr->words[obj] < max ? hdr->words[obj] : max;
+    size_t offset = hdr->rate_offset[obj] + (size_t)index * hdr->words[obj] * sizeof(stats_history_rate_t);
+    if (!stats_history_read(hdr, offset, n * sizeof(*rates), rates, NULL, NULL)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    *count = n;
+    return STATUS_SUCCESS;
+}
+
+status_t stats_history_get_series(const stats_history_header_t *hdr, telemetry_object_t obj,
+                                  uint32_t index, uint32_t counter, uint64_t *values,
+                                  uint64_t *times_ns, uint32_t max, uint32_t *count) {
+    const uint64_t *times;
+    const uint64_t *block;
+    uint64_t begin;
+    uint32_t head, n, words;
+
+    if (!values || !count || !stats_history_valid(hdr, obj, index) || counter >= hdr->words[obj]) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    words = hdr->words[obj];
+    times = (const uint64_t *)((const uint8_t *)hdr + hdr->time_offset);
+    block = stats_history_slot(hdr, obj, index, 0);
+
+    // Values and times of one sample must come from the same publication
+    do {
+        while ((begin = __atomic_load_n(&hdr->sequence, __ATOMIC_ACQUIRE)) & 1) {
+            sched_yield();
+        }
+        head = hdr->head;
+        n = hdr->samples < max ? hdr->samples : max;
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t slot = (head + hdr->slots - (n - 1 - i)) % hdr->slots;
+            values[i] = block[(size_t)slot * words + counter];
+            if (times_ns) {
+                times_ns[i] = times[slot];
+            }
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&hdr->sequence, __ATOMIC_RELAXED) != begin);
+
+    *count = n;
+    return STATUS_SUCCESS;
+}
+
+status_t stats_history_port_utilization(const stats_history_header_t *hdr, uint32_t port,
+                                        stats_history_utilization_t *util) {
+    stats_history_rate_t rates[STATS_HISTORY_PORT_TX_BYTES + 1];
+    const uint64_t *speeds;
+    uint32_t count;
+    double capacity;
+
+    if (!util || !stats_history_valid(hdr, TELEMETRY_OBJ_PORT, port) ||
+        hdr->words[TELEMETRY_OBJ_PORT] <= STATS_HISTORY_PORT_TX_BYTES) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (stats_history_get_rates(hdr, TELEMETRY_OBJ_PORT, port, rates,
+                                STATS_HISTORY_PORT_TX_BYTES + 1, &count) != STATUS_SUCCESS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    speeds = (const uint64_t *)((const uint8_t *)hdr + hdr->speed_offset);
+    memset(util, 0, sizeof(*util));
+    util->speed_mbps = __atomic_load_n(&speeds[port], __ATOMIC_RELAXED);
+    util->rx_bps = rates[STATS_HISTORY_PORT_RX_BYTES].rate * 8;
+    util->tx_bps = rates[STATS_HISTORY_PORT_TX_BYTES].rate * 8;
+    util->rx_avg_bps = rates[STATS_HISTORY_PORT_RX_BYTES].ewma * 8;
+    util->tx_avg_bps = rates[STATS_HISTORY_PORT_TX_BYTES].ewma * 8;
+    util->rx_peak_bps = rates[STATS_HISTORY_PORT_RX_BYTES].peak * 8;
+    util->tx_peak_bps = rates[STATS_HISTORY_PORT_TX_BYTES].peak * 8;
+
+    capacity = (double)util->speed_mbps * 1e6;
+    if (capacity > 0) {
+        util->rx_percent = util->rx_bps * 100 / capacity;
+        util->tx_percent = util->tx_bps * 100 / capacity;
+    }
+    return STATUS_SUCCESS;
+}
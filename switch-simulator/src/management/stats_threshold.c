@@ -0,0 +1,559 @@
+/**
+ * @file stats_threshold.c
+ * @brief Threshold monitoring over the statistics counters
+ *
+ * Every interval the statistics module copies the counters of the watched
+ * object types into a flat snapshot, one uint64_t slot per counter. Value
+ * and rate thresholds are kept in separate arrays of slots and limits, so
+ * the comparison is a straight loop over them. Crossings are queued to a
+ * dispatcher thread; a full queue drops events rather than stall the
+ * collection thread.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../../include/management/stats_threshold.h"
+#include "../../include/common/logging.h"
+
+/**
+ * @brief Thresholds of one kind, one array per field
+ */
+typedef struct {
+    uint32_t *slot;                     /* Snapshot slot watched */
+    uint64_t *limit;
+    uint8_t *over;                      /* Exceeded in the last evaluation */
+    uint8_t *armed;                     /* Fires on the next crossing */
+    void (**callback)(void *user_data);
+    void **user_data;
+    uint32_t *id;
+    uint32_t count;
+    uint32_t capacity;
+} threshold_group_t;
+
+/**
+ * @brief Queued callback
+ */
+typedef struct {
+    void (*callback)(void *user_data);
+    void *user_data;
+} threshold_event_t;
+
+struct stats_threshold_engine {
+    uint32_t counts[TELEMETRY_OBJ_COUNT];
+    uint32_t words[TELEMETRY_OBJ_COUNT];
+    size_t base[TELEMETRY_OBJ_COUNT];   /* First slot of each type */
+    size_t slots;
+    uint64_t *cur;                      /* Snapshot being evaluated */
+    uint64_t *prev;                     /* Snapshot of the previous interval */
+    uint64_t cur_ns;                    /* CLOCK_MONOTONIC of each snapshot */
+    uint64_t prev_ns;
+    bool have_prev;
+
+    pthread_mutex_t lock;               /* Thresholds, held while evaluating */
+    threshold_group_t groups[2];        /* By stats_threshold_kind_t */
+    uint32_t watched[TELEMETRY_OBJ_COUNT]; /* Thresholds per object type */
+    uint32_t next_id;
+
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_cond;
+    threshold_event_t queue[STATS_THRESHOLD_EVENT_QUEUE];
+    uint32_t queue_head;
+    uint32_t queue_len;
+    uint64_t dropped;
+    bool stopping;
+    pthread_t dispatcher;
+};
+
+/**
+ * @brief Counter names of each object type, in stats_export_*_t field order
+ */
+static const char *const port_counters[] = {
+    "rx_packets", "tx_packets", "rx_bytes", "tx_bytes",
+    "rx_errors", "tx_errors", "rx_drops", "tx_drops",
+    "rx_unicast", "tx_unicast", "rx_broadcast", "tx_broadcast",
+    "rx_multicast", "tx_multicast", "collisions", "last_clear", NULL
+};
+static const char *const vlan_counters[] = {
+    "rx_packets", "tx_packets", "rx_bytes", "tx_bytes",
+    "storm_dropped_packets", "storm_dropped_bytes", "last_clear", NULL
+};
+static const char *const queue_counters[] = {
+    "enqueued", "dequeued", "dropped", "current_depth", "max_depth", "last_clear", NULL
+};
+static const char *const routing_counters[] = {
+    "routed_packets", "routed_bytes", "routing_failures",
+    "arp_requests", "arp_replies", "last_clear", NULL
+};
+static const char *const int_counters[] = {
+    "switch_id", "egress_port", "packets", "latency_total_ns", "latency_max_ns",
+    "depth_total", "depth_max", NULL
+};
+
+static const struct {
+    const char *prefix;
+    const char *const *counters;
+} object_names[TELEMETRY_OBJ_COUNT] = {
+    [TELEMETRY_OBJ_PORT] = { "port_", port_counters },
+    [TELEMETRY_OBJ_VLAN] = { "vlan_", vlan_counters },
+    [TELEMETRY_OBJ_QUEUE] = { "queue_", queue_counters },
+    [TELEMETRY_OBJ_ROUTING] = { "routing_", routing_counters },
+    [TELEMETRY_OBJ_INT] = { "int_", int_counters },
+};
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * @brief Dispatcher thread: run queued callbacks outside every engine lock
+ */
+static void *threshold_dispatcher(void *arg) {
+    stats_threshold_engine_t *engine = (stats_threshold_engine_t *)arg;
+    threshold_event_t event;
+
+    pthread_mutex_lock(&engine->queue_lock);
+    for (;;) {
+        while (engine->queue_len == 0 && !engine->stopping) {
+            pthread_cond_wait(&engine->queue_cond, &engine->queue_lock);
+        }
+        if (engine->stopping) {
+            break;
+        }
+        event = engine->queue[engine->queue_head];
+        engine->queue_head = (engine->queue_head + 1) % STATS_THRESHOLD_EVENT_QUEUE;
+        engine->queue_len--;
+
+        pthread_mutex_unlock(&engine->queue_lock);
+        event.callback(event.user_data);
+        pthread_mutex_lock(&engine->queue_lock);
+    }
+    pthread_mutex_unlock(&engine->queue_lock);
+
+    return NULL;
+}
+
+status_t stats_threshold_engine_create(const uint32_t counts[TELEMETRY_OBJ_COUNT],
+                                       const uint32_t words[TELEMETRY_OBJ_COUNT],
+                                       stats_threshold_engine_t **engine) {
+    stats_threshold_engine_t *new_engine;
+    size_t slots = 0;
+
+    if (!counts || !words || !engine) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    new_engine = (stats_threshold_engine_t *)calloc(1, sizeof(*new_engine));
+    if (!new_engine) {
+        return STATUS_NO_MEMORY;
+    }
+    for (int i = 0; i < TELEMETRY_OBJ_COUNT; i++) {
+        new_engine->counts[i] = counts[i];
+        new_engine->words[i] = words[i];
+        new_engine->base[i] = slots;
+        slots += (size_t)counts[i] * words[i];
+    }
+    new_engine->slots = slots;
+    new_engine->next_id = 1;
+    new_engine->cur = (uint64_t *)calloc(slots ? slots : 1, sizeof(uint64_t));
+    new_engine->prev = (uint64_t *)calloc(slots ? slots : 1, sizeof(uint64_t));
+    if (!new_engine->cur || !new_engine->prev) {
+        free(new_engine->cur);
+        free(new_engine->prev);
+        free(new_engine);
+        return STATUS_NO_MEMORY;
+    }
+
+    if (pthread_mutex_init(&new_engine->lock, NULL) != 0) {
+        goto fail_lock;
+    }
+    if (pthread_mutex_init(&new_engine->queue_lock, NULL) != 0) {
+        goto fail_queue_lock;
+    }
+    if (pthread_cond_init(&new_engine->queue_cond, NULL) != 0) {
+        goto fail_cond;
+    }
+    if (pthread_create(&new_engine->dispatcher, NULL, threshold_dispatcher, new_engine) != 0) {
+        goto fail_thread;
+    }
+
+    *engine = new_engine;
+    return STATUS_SUCCESS;
+
+fail_thread:
+    pthread_cond_destroy(&new_engine->queue_cond);
+fail_cond:
+    pthread_mutex_destroy(&new_engine->queue_lock);
+fail_queue_lock:
+    pthread_mutex_destroy(&new_engine->lock);
+fail_lock:
+    free(new_engine->cur);
+    free(new_engine->prev);
+    free(new_engine);
+    return STATUS_FAILURE;
+}
+
+static void threshold_group_free(threshold_group_t *group) {
+    free(group->slot);
+    free(group->limit);
+    free(group->over);
+    free(group->armed);
+    free(group->callback);
+    free(group->user_data);
+    free(group->id);
+}
+
+void stats_threshold_engine_destroy(stats_threshold_engine_t *engine) {
+    if (!engine) {
+        return;
+    }
+
+    pthread_mutex_lock(&engine->queue_lock);
+    engine->stopping = true;
+    pthread_cond_signal(&engine->queue_cond);
+    pthread_mutex_unlock(&engine->queue_lock);
+    pthread_join(engine->dispatcher, NULL);
+
+    pthread_cond_destroy(&engine->queue_cond);
+    pthread_mutex_destroy(&engine->queue_lock);
+    pthread_mutex_destroy(&engine->lock);
+    for (int i = 0; i < 2; i++) {
+        threshold_group_free(&engine->groups[i]);
+    }
+    free(engine->cur);
+    free(engine->prev);
+    free(engine);
+}
+
+/**
+ * @brief Make room for one more threshold in a group
+ */
+static status_t threshold_group_reserve(threshold_group_t *group) {
+    uint32_t capacity;
+    void *p;
+
+    if (group->count < group->capacity) {
+        return STATUS_SUCCESS;
+    }
+    capacity = group->capacity ? group->capacity * 2 : 64;
+
+    // Arrays that were grown keep their size if a later one fails
+#define THRESHOLD_GROW(field)                                                   \
+    do {                                                                        \
+        p = realloc(group->field, (size_t)capacity * sizeof(*group->field));    \
+        if (!p) {                                                               \
+            return STATUS_NO_MEMORY;                                            \
+        }                                                                       \
+        group->field = p;                                                       \
+    } while (0)
+
+    THRESHOLD_GROW(slot);
+    THRESHOLD_GROW(limit);
+    THRESHOLD_GROW(over);
+    THRESHOLD_GROW(armed);
+    THRESHOLD_GROW(callback);
+    THRESHOLD_GROW(user_data);
+    THRESHOLD_GROW(id);
+#undef THRESHOLD_GROW
+
+    group->capacity = capacity;
+    return STATUS_SUCCESS;
+}
+
+status_t stats_threshold_add(stats_threshold_engine_t *engine, const stats_threshold_t *threshold,
+                             uint32_t *id) {
+    threshold_group_t *group;
+    status_t status;
+    uint32_t n;
+
+    if (!engine || !threshold || !threshold->callback ||
+        (unsigned)threshold->object >= TELEMETRY_OBJ_COUNT ||
+        (threshold->kind != STATS_THRESHOLD_VALUE && threshold->kind != STATS_THRESHOLD_RATE) ||
+        threshold->index >= engine->counts[threshold->object] ||
+        threshold->counter >= engine->words[threshold->object]) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&engine->lock);
+    group = &engine->groups[threshold->kind];
+    status = threshold_group_reserve(group);
+    if (status != STATUS_SUCCESS) {
+        pthread_mutex_unlock(&engine->lock);
+        return status;
+    }
+
+    n = group->count++;
+    group->slot[n] = (uint32_t)(engine->base[threshold->object] +
+                                (size_t)threshold->index * engine->words[threshold->object] +
+                                threshold->counter);
+    group->limit[n] = threshold->threshold;
+    group->over[n] = 0;
+    group->armed[n] = 1;
+    group->callback[n] = threshold->callback;
+    group->user_data[n] = threshold->user_data;
+    group->id[n] = engine->next_id++;
+    engine->watched[threshold->object]++;
+    if (id) {
+        *id = group->id[n];
+    }
+    pthread_mutex_unlock(&engine->lock);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Object type of a snapshot slot
+ */
+static telemetry_object_t threshold_slot_object(const stats_threshold_engine_t *engine, uint32_t slot) {
+    int obj = TELEMETRY_OBJ_COUNT - 1;
+
+    while (obj > 0 && slot < engine->base[obj]) {
+        obj--;
+    }
+    return (telemetry_object_t)obj;
+}
+
+status_t stats_threshold_remove(stats_threshold_engine_t *engine, uint32_t id) {
+    if (!engine) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&engine->lock);
+    for (int k = 0; k < 2; k++) {
+        threshold_group_t *group = &engine->groups[k];
+
+        for (uint32_t i = 0; i < group->count; i++) {
+            if (group->id[i] != id) {
+                continue;
+            }
+            engine->watched[threshold_slot_object(engine, group->slot[i])]--;
+
+            // Order does not matter, so the last threshold fills the gap
+            uint32_t last = --group->count;
+            group->slot[i] = group->slot[last];
+            group->limit[i] = group->limit[last];
+            group->over[i] = group->over[last];
+            group->armed[i] = group->armed[last];
+            group->callback[i] = group->callback[last];
+            group->user_data[i] = group->user_data[last];
+            group->id[i] = group->id[last];
+            pthread_mutex_unlock(&engine->lock);
+            return STATUS_SUCCESS;
+        }
+    }
+    pthread_mutex_unlock(&engine->lock);
+
+    return STATUS_NOT_FOUND;
+}
+
+/**
+ * @brief Parse a decimal number up to the next '_' or the end
+ */
+static const char *threshold_parse_number(const char *p, uint32_t *value) {
+    uint64_t v = 0;
+
+    if (*p < '0' || *p > '9') {
+        return NULL;
+    }
+    while (*p >= '0' && *p <= '9') {
+        v = v * 10 + (uint64_t)(*p++ - '0');
+        if (v > UINT32_MAX) {
+            return NULL;
+        }
+    }
+    *value = (uint32_t)v;
+    return p;
+}
+
+status_t stats_threshold_parse(const char *name, uint32_t queues_per_port,
+                               stats_threshold_t *threshold) {
+    const char *p = NULL;
+    size_t len;
+    int obj;
+    int c;
+
+    if (!name || !threshold) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    for (obj = 0; obj < TELEMETRY_OBJ_COUNT; obj++) {
+        len = strlen(object_names[obj].prefix);
+        if (strncmp(name, object_names[obj].prefix, len) == 0) {
+            p = name + len;
+            break;
+        }
+    }
+    if (!p) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    // Counter names contain '_' too, so match whole names against the table
+    for (c = 0; object_names[obj].counters[c]; c++) {
+        len = strlen(object_names[obj].counters[c]);
+        if (strncmp(p, object_names[obj].counters[c], len) == 0 &&
+            (p[len] == '\0' || p[len] == '_')) {
+            p += len;
+            break;
+        }
+    }
+    if (!object_names[obj].counters[c]) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    threshold->object = (telemetry_object_t)obj;
+    threshold->counter = (uint32_t)c;
+    threshold->index = 0;
+
+    if (obj == TELEMETRY_OBJ_ROUTING) {
+        return *p == '\0' ? STATUS_SUCCESS : STATUS_INVALID_PARAMETER;
+    }
+    if (*p++ != '_' || !(p = threshold_parse_number(p, &threshold->index))) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (obj == TELEMETRY_OBJ_QUEUE) {
+        uint32_t queue;
+
+        if (*p++ != '_' || !(p = threshold_parse_number(p, &queue)) || queue >= queues_per_port) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        threshold->index = threshold->index * queues_per_port + queue;
+    }
+
+    return *p == '\0' ? STATUS_SUCCESS : STATUS_INVALID_PARAMETER;
+}
+
+uint32_t stats_threshold_objects(stats_threshold_engine_t *engine) {
+    uint32_t objects = 0;
+
+    pthread_mutex_lock(&engine->lock);
+    for (int i = 0; i < TELEMETRY_OBJ_COUNT; i++) {
+        if (engine->watched[i]) {
+            objects |= TELEMETRY_SUBSCRIBE(i);
+        }
+    }
+    pthread_mutex_unlock(&engine->lock);
+
+    return objects;
+}
+
+void stats_threshold_begin(stats_threshold_engine_t *engine) {
+    engine->cur_ns = monotonic_ns();
+
+    // Only active VLANs are recorded; the others read as zero
+    memset(engine->cur + engine->base[TELEMETRY_OBJ_VLAN], 0,
+           (size_t)engine->counts[TELEMETRY_OBJ_VLAN] * engine->words[TELEMETRY_OBJ_VLAN] * sizeof(uint64_t));
+}
+
+void stats_threshold_record(void *arg, telemetry_object_t obj, uint32_t index,
+                            const uint64_t *counters) {
+    stats_threshold_engine_t *engine = (stats_threshold_engine_t *)arg;
+
+    if ((unsigned)obj >= TELEMETRY_OBJ_COUNT || index >= engine->counts[obj]) {
+        return;
+    }
+    memcpy(engine->cur + engine->base[obj] + (size_t)index * engine->words[obj], counters,
+           engine->words[obj] * sizeof(uint64_t));
+}
+
+/**
+ * @brief Queue the callbacks of thresholds that crossed since the last evaluation
+ *
+ * Called with engine->lock held, after the over flags were computed.
+ */
+static uint32_t threshold_group_fire(stats_threshold_engine_t *engine, threshold_group_t *group) {
+    uint32_t fired = 0;
+
+    for (uint32_t i = 0; i < group->count; i++) {
+        if (!group->over[i]) {
+            // Back at or under the limit: the next crossing fires again
+            group->armed[i] = 1;
+            continue;
+        }
+        if (!group->armed[i]) {
+            continue;
+        }
+        group->armed[i] = 0;
+        fired++;
+
+        if (engine->queue_len == STATS_THRESHOLD_EVENT_QUEUE) {
+            engine->dropped++;
+            continue;
+        }
+        threshold_event_t *event =
+            &engine->queue[(engine->queue_head + engine->queue_len) % STATS_THRESHOLD_EVENT_QUEUE];
+        event->callback = group->callback[i];
+        event->user_data = group->user_data[i];
+        engine->queue_len++;
+    }
+
+    return fired;
+}
+
+uint32_t stats_threshold_evaluate(stats_threshold_engine_t *engine) {
+    threshold_group_t *value = &engine->groups[STATS_THRESHOLD_VALUE];
+    threshold_group_t *rate = &engine->groups[STATS_THRESHOLD_RATE];
+    const uint64_t *restrict cur = engine->cur;
+    const uint64_t *restrict prev = engine->prev;
+    uint32_t fired;
+
+    pthread_mutex_lock(&engine->lock);
+
+    // Branch-free comparisons over the arrays, so the compiler can vectorize them
+    {
+        const uint32_t *restrict slot = value->slot;
+        const uint64_t *restrict limit = value->limit;
+        uint8_t *restrict over = value->over;
+
+        for (uint32_t i = 0; i < value->count; i++) {
+            over[i] = cur[slot[i]] > limit[i];
+        }
+    }
+    {
+        const uint32_t *restrict slot = rate->slot;
+        const uint64_t *restrict limit = rate->limit;
+        uint8_t *restrict over = rate->over;
+        // Limits are per second; scale them to the time between the snapshots
+        double seconds = engine->have_prev ? (double)(engine->cur_ns - engine->prev_ns) / 1e9 : 0.0;
+        uint8_t valid = engine->have_prev && engine->cur_ns > engine->prev_ns;
+
+        for (uint32_t i = 0; i < rate->count; i++) {
+            uint64_t now = cur[slot[i]];
+            uint64_t then = prev[slot[i]];
+            // A counter that went down was cleared: no rate this interval
+            uint64_t delta = now >= then ? now - then : 0;
+
+            over[i] = valid & ((double)delta > (double)limit[i] * seconds);
+        }
+    }
+
+    pthread_mutex_lock(&engine->queue_lock);
+    fired = threshold_group_fire(engine, value);
+    fired += threshold_group_fire(engine, rate);
+    if (engine->queue_len) {
+        pthread_cond_signal(&engine->queue_cond);
+    }
+    pthread_mutex_unlock(&engine->queue_lock);
+
+    pthread_mutex_unlock(&engine->lock);
+
+    memcpy(engine->prev, engine->cur, engine->slots * sizeof(uint64_t));
+    engine->prev_ns = engine->cur_ns;
+    engine->have_prev = true;
+
+    return fired;
+}
+
+uint64_t stats_threshold_dropped_events(stats_threshold_engine_t *engine) {
+    uint64_t dropped;
+
+    pthread_mutex_lock(&engine->queue_lock);
+    dropped = engine->dropped;
+    pthread_mutex_unlock(&engine->queue_lock);
+
+    return dropped;
+}
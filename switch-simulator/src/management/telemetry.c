@@ -0,0 +1,262 @@
+/**
+ * @file telemetry.c
+ * @brief Streaming telemetry: push changed counters over UDP
+ *
+ * The exporter keeps the values it last sent for every object and
+ * compares against them, so an interval in which nothing moved costs one
+ * header-only datagram. It is driven by a single thread.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "../../include/management/telemetry.h"
+#include "../../include/common/logging.h"
+
+/** Longest record: type, index, mask and one varint per counter */
+#define TELEMETRY_MAX_RECORD (1 + 5 + 5 + TELEMETRY_MAX_COUNTERS * 10)
+
+/**
+ * @brief Exporter
+ */
+struct telemetry {
+    int fd;                                     /* Connected UDP socket */
+    telemetry_config_t config;                  /* host is not kept */
+    uint32_t counts[TELEMETRY_OBJ_COUNT];
+    uint32_t words[TELEMETRY_OBJ_COUNT];
+    uint64_t *last[TELEMETRY_OBJ_COUNT];        /* Values sent for each object */
+    uint32_t sequence;
+    uint32_t interval;
+    uint32_t since_keyframe;
+    bool keyframe;                              /* Current interval is a keyframe */
+    uint64_t time_ns;                           /* Time of the current interval */
+    uint8_t buf[TELEMETRY_MAX_DATAGRAM];
+    size_t len;                                 /* Bytes in buf, 0 if no header yet */
+};
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static size_t put_varint(uint8_t *p, uint64_t v) {
+    size_t n = 0;
+
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+/**
+ * @brief Start a datagram with the header of the current interval
+ */
+static void telemetry_start_datagram(telemetry_t *tel) {
+    uint8_t *p = tel->buf;
+
+    put_u32(p, TELEMETRY_MAGIC);
+    p[4] = TELEMETRY_VERSION;
+    p[5] = tel->keyframe ? TELEMETRY_FLAG_KEYFRAME : 0;
+    p[6] = 0;
+    p[7] = 0;
+    put_u32(p + 8, tel->sequence++);
+    put_u32(p + 12, tel->interval);
+    put_u32(p + 16, (uint32_t)tel->time_ns);
+    put_u32(p + 20, (uint32_t)(tel->time_ns >> 32));
+    tel->len = TELEMETRY_HEADER_SIZE;
+}
+
+/**
+ * @brief Send the datagram being built
+ */
+static void telemetry_flush(telemetry_t *tel, bool end) {
+    if (end) {
+        tel->buf[5] |= TELEMETRY_FLAG_END;
+    }
+    // The collector may be down; the next keyframe makes up for lost data
+    if (send(tel->fd, tel->buf, tel->len, MSG_DONTWAIT) < 0 && errno != ECONNREFUSED &&
+        errno != EAGAIN && errno != EWOULDBLOCK) {
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Telemetry: send failed: %s", strerror(errno));
+    }
+    tel->len = 0;
+}
+
+status_t telemetry_create(const telemetry_config_t *config,
+                          const uint32_t counts[TELEMETRY_OBJ_COUNT],
+                          const uint32_t words[TELEMETRY_OBJ_COUNT],
+                          telemetry_t **tel) {
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+    telemetry_t *new_tel;
+    char service[8];
+    int rc;
+
+    if (!config || !config->host || config->port == 0 || config->interval_ms == 0 ||
+        !counts || !words || !tel) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    for (int i = 0; i < TELEMETRY_OBJ_COUNT; i++) {
+        if (words[i] > TELEMETRY_MAX_COUNTERS) {
+            return STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    new_tel = (telemetry_t *)calloc(1, sizeof(*new_tel));
+    if (!new_tel) {
+        return STATUS_NO_MEMORY;
+    }
+    new_tel->fd = -1;
+    new_tel->config = *config;
+    new_tel->config.host = NULL;
+    for (int i = 0; i < TELEMETRY_OBJ_COUNT; i++) {
+        new_tel->counts[i] = counts[i];
+        new_tel->words[i] = words[i];
+        if (!telemetry_subscribed(new_tel, (telemetry_object_t)i) || counts[i] == 0 || words[i] == 0) {
+            continue;
+        }
+        new_tel->last[i] = (uint64_t *)calloc((size_t)counts[i] * words[i], sizeof(uint64_t));
+        if (!new_tel->last[i]) {
+            telemetry_destroy(new_tel);
+            return STATUS_NO_MEMORY;
+        }
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    snprintf(service, sizeof(service), "%u", config->port);
+    rc = getaddrinfo(config->host, service, &hints, &res);
+    if (rc != 0) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Telemetry: cannot resolve %s: %s", config->host, gai_strerror(rc));
+        telemetry_destroy(new_tel);
+        return STATUS_FAILURE;
+    }
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        new_tel->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (new_tel->fd < 0) {
+            continue;
+        }
+        if (connect(new_tel->fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(new_tel->fd);
+        new_tel->fd = -1;
+    }
+    freeaddrinfo(res);
+    if (new_tel->fd < 0) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Telemetry: cannot reach %s:%u", config->host, config->port);
+        telemetry_destroy(new_tel);
+        return STATUS_FAILURE;
+    }
+
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Telemetry: pushing to %s:%u every %u ms",
+             config->host, config->port, config->interval_ms);
+    *tel = new_tel;
+    return STATUS_SUCCESS;
+}
+
+void telemetry_destroy(telemetry_t *tel) {
+    if (!tel) {
+        return;
+    }
+
+    if (tel->fd >= 0) {
+        close(tel->fd);
+    }
+    for (int i = 0; i < TELEMETRY_OBJ_COUNT; i++) {
+        free(tel->last[i]);
+    }
+    free(tel);
+}
+
+bool telemetry_subscribed(const telemetry_t *tel, telemetry_object_t obj) {
+    return obj < TELEMETRY_OBJ_COUNT && (tel->config.subscriptions & TELEMETRY_SUBSCRIBE(obj)) != 0;
+}
+
+uint32_t telemetry_interval_ms(const telemetry_t *tel) {
+    return tel->config.interval_ms;
+}
+
+void telemetry_begin(telemetry_t *tel) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    tel->time_ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+
+    // The first interval is always a keyframe: there is nothing to diff against
+    tel->keyframe = tel->interval == 0 ||
+                    (tel->config.keyframe_every != 0 && ++tel->since_keyframe >= tel->config.keyframe_every);
+    if (tel->keyframe) {
+        tel->since_keyframe = 0;
+    }
+    tel->len = 0;
+}
+
+void telemetry_record(telemetry_t *tel, telemetry_object_t obj, uint32_t index,
+                      const uint64_t *counters) {
+    uint8_t record[TELEMETRY_MAX_RECORD];
+    uint64_t *last;
+    uint32_t words;
+    uint32_t mask = 0;
+    size_t n;
+
+    if (!telemetry_subscribed(tel, obj) || !tel->last[obj] || index >= tel->counts[obj]) {
+        return;
+    }
+    words = tel->words[obj];
+    last = tel->last[obj] + (size_t)index * words;
+
+    for (uint32_t i = 0; i < words; i++) {
+        if (tel->keyframe || counters[i] != last[i]) {
+            mask |= 1u << i;
+        }
+    }
+    if (mask == 0) {
+        return;
+    }
+
+    record[0] = (uint8_t)obj;
+    n = 1;
+    n += put_varint(record + n, index);
+    n += put_varint(record + n, mask);
+    for (uint32_t i = 0; i < words; i++) {
+        if (!(mask & (1u << i))) {
+            continue;
+        }
+        if (tel->keyframe) {
+            n += put_varint(record + n, counters[i]);
+        } else {
+            int64_t delta = (int64_t)(counters[i] - last[i]);
+            n += put_varint(record + n, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+        }
+        last[i] = counters[i];
+    }
+
+    if (tel->len != 0 && tel->len + n > sizeof(tel->buf)) {
+        telemetry_flush(tel, false);
+    }
+    if (tel->len == 0) {
+        telemetry_start_datagram(tel);
+    }
+    memcpy(tel->buf + tel->len, record, n);
+    tel->len += n;
+}
+
+void telemetry_end(telemetry_t *tel) {
+    // An interval without changes still sends its header, as a heartbeat
+    if (tel->len == 0) {
+        telemetry_start_datagram(tel);
+    }
+    telemetry_flush(tel, true);
+    tel->interval++;
+}
@@ -0,0 +1,491 @@
+/**
+ * @file warm_restart.c
+ * @brief Implementation of warm restart checkpoints
+ *
+ * A checkpoint is written to "<path>.tmp", synced and renamed over the
+ * previous one. The routes are written straight from a routing table
+ * walk; the ARP and MAC entries from copies taken without blocking
+ * forwarding. On restore the file is mapped read-only and the route
+ * records are handed to the routing table in place.
+ */
+
+#include "management/warm_restart.h"
+#include "l3/routing_table.h"
+#include "l3/arp.h"
+#include "l2/mac_table.h"
+#include "common/config.h"
+#include "common/event_loop.h"
+#include "common/logging.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Private data types */
+
+/* Checkpoint being written */
+typedef struct {
+    FILE *file;
+    uint32_t count;
+    bool error;
+} warm_writer_t;
+
+/* Module state */
+typedef struct {
+    const char *path;
+    warm_restart_config_t config;
+    event_timer_t sweep_timer;
+    event_timer_t checkpoint_timer;
+    bool stale_pending;             /* Restored routes await the sweep */
+    bool initialized;
+} warm_restart_state_t;
+
+static warm_restart_state_t g_warm;
+
+/* Forward declarations of private functions */
+static uint64_t warm_now_us(void);
+static bool warm_header_valid(const warm_restart_header_t *header, size_t size);
+static void warm_write_route(const routing_route_t *route, void *ctx);
+static bool warm_write_arp(FILE *file, uint32_t *count);
+static bool warm_write_mac(FILE *file, uint32_t *count);
+static void warm_restore_arp(const warm_restart_arp_record_t *records, uint32_t count, uint32_t *restored);
+static void warm_restore_mac(const mac_table_export_record_t *records, uint32_t count, uint32_t *restored);
+static void warm_sweep_timer_cb(event_timer_t *timer, void *arg);
+static void warm_checkpoint_timer_cb(event_timer_t *timer, void *arg);
+
+/**
+ * @brief Get the default parameters
+ *
+ * @param[out] config Parameters
+ */
+void warm_restart_get_default_config(warm_restart_config_t *config) {
+    if (!config) {
+        return;
+    }
+    memset(config, 0, sizeof(*config));
+    config->stale_hold_ms = WARM_RESTART_DEFAULT_HOLD_MS;
+}
+
+/**
+ * @brief Set the checkpoint file and parameters
+ *
+ * @param path Checkpoint file, kept by reference
+ * @param config Parameters, NULL for the defaults
+ * @return STATUS_SUCCESS on success, STATUS_INVALID_PARAMETER
+ */
+status_t warm_restart_init(const char *path, const warm_restart_config_t *config) {
+    if (!path || path[0] == '\0') {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    warm_restart_deinit();
+    g_warm.path = path;
+    if (config) {
+        g_warm.config = *config;
+    } else {
+        warm_restart_get_default_config(&g_warm.config);
+    }
+    event_timer_init(&g_warm.sweep_timer, warm_sweep_timer_cb, NULL);
+    event_timer_init(&g_warm.checkpoint_timer, warm_checkpoint_timer_cb, NULL);
+    g_warm.initialized = true;
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Stop the timers; the checkpoint file is left in place
+ */
+void warm_restart_deinit(void) {
+    if (!g_warm.initialized) {
+        return;
+    }
+    (void)event_timer_stop(&g_warm.sweep_timer);
+    (void)event_timer_stop(&g_warm.checkpoint_timer);
+    memset(&g_warm, 0, sizeof(g_warm));
+}
+
+/**
+ * @brief Restore the tables from the checkpoint
+ *
+ * @param[out] stats Results, may be NULL
+ * @return STATUS_SUCCESS on success, error code otherwise
+ */
+status_t warm_restart_restore(warm_restart_stats_t *stats) {
+    warm_restart_stats_t result;
+    struct stat st;
+    status_t status;
+    uint64_t start_us = warm_now_us();
+
+    if (!g_warm.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    memset(&result, 0, sizeof(result));
+
+    int fd = open(g_warm.path, O_RDONLY);
+    if (fd < 0) {
+        LOG_INFO(LOG_CATEGORY_SYSTEM, "No warm restart checkpoint at %s, cold start", g_warm.path);
+        return STATUS_NOT_FOUND;
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(warm_restart_header_t)) {
+        close(fd);
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Warm restart checkpoint %s is truncated, cold start", g_warm.path);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    size_t size = (size_t)st.st_size;
+    const uint8_t *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Cannot map warm restart checkpoint %s", g_warm.path);
+        return STATUS_NO_MEMORY;
+    }
+
+    const warm_restart_header_t *header = (const warm_restart_header_t *)base;
+    if (!warm_header_valid(header, size)) {
+        munmap((void *)base, size);
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "%s is not a checkpoint of this build, cold start", g_warm.path);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    uint64_t now = (uint64_t)time(NULL);
+    result.age_s = now > header->timestamp ? now - header->timestamp : 0;
+    if (g_warm.config.max_age_s != 0 && result.age_s > g_warm.config.max_age_s) {
+        munmap((void *)base, size);
+        LOG_WARNING(LOG_CATEGORY_SYSTEM, "Warm restart checkpoint %s is %llu s old, cold start",
+                    g_warm.path, (unsigned long long)result.age_s);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    const routing_route_t *routes = (const routing_route_t *)(base + header->header_size);
+    const warm_restart_arp_record_t *arp = (const warm_restart_arp_record_t *)(routes + header->route_count);
+    const mac_table_export_record_t *mac = (const mac_table_export_record_t *)(arp + header->arp_count);
+
+    (void)madvise((void *)base, size, MADV_SEQUENTIAL);
+
+    /* Neighbors first, so that the routes forward as soon as they are installed */
+    warm_restore_mac(mac, header->mac_count, &result.mac_entries);
+    warm_restore_arp(arp, header->arp_count, &result.arp_entries);
+
+    result.routes = header->route_count;
+    status = routing_table_restore_routes(routes, header->route_count, &result.routes_added);
+    munmap((void *)base, size);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Restoring routes from %s failed: %d", g_warm.path, status);
+        return status;
+    }
+    g_warm.stale_pending = result.routes_added > 0;
+
+    result.elapsed_us = warm_now_us() - start_us;
+    LOG_INFO(LOG_CATEGORY_SYSTEM,
+             "Warm restart from %s (%llu s old): %u routes, %u ARP and %u MAC entries in %llu us",
+             g_warm.path, (unsigned long long)result.age_s, result.routes_added, result.arp_entries,
+             result.mac_entries, (unsigned long long)result.elapsed_us);
+
+    if (stats) {
+        *stats = result;
+    }
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Arm the stale route sweep and the periodic checkpoints
+ *
+ * @return STATUS_SUCCESS on success, error code otherwise
+ */
+status_t warm_restart_start(void) {
+    status_t status;
+
+    if (!g_warm.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+
+    if (g_warm.stale_pending && g_warm.config.stale_hold_ms != 0) {
+        status = event_timer_start(&g_warm.sweep_timer, (uint64_t)g_warm.config.stale_hold_ms * 1000u, 0);
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+    }
+
+    if (g_warm.config.checkpoint_interval_ms != 0) {
+        uint64_t interval_us = (uint64_t)g_warm.config.checkpoint_interval_ms * 1000u;
+        status = event_timer_start(&g_warm.checkpoint_timer, interval_us, interval_us);
+        if (status != STATUS_SUCCESS) {
+            return status;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/**
+ * @brief Write a checkpoint of the current tables
+ *
+ * @param[out] stats Results, may be NULL
+ * @return STATUS_SUCCESS on success, error code otherwise
+ */
+status_t warm_restart_checkpoint(warm_restart_stats_t *stats) {
+    warm_restart_header_t header;
+    warm_writer_t writer;
+    warm_restart_stats_t result;
+    char tmp_path[PATH_MAX];
+    status_t status;
+    uint64_t start_us = warm_now_us();
+
+    if (!g_warm.initialized) {
+        return STATUS_NOT_INITIALIZED;
+    }
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", g_warm.path) >= (int)sizeof(tmp_path)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    memset(&result, 0, sizeof(result));
+
+    memset(&writer, 0, sizeof(writer));
+    writer.file = fopen(tmp_path, "wb");
+    if (!writer.file) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Cannot create warm restart checkpoint %s", tmp_path);
+        return STATUS_FAILURE;
+    }
+    (void)setvbuf(writer.file, NULL, _IOFBF, 1 << 20);
+
+    /* The counts are filled in once the sections are written */
+    memset(&header, 0, sizeof(header));
+    header.magic = WARM_RESTART_MAGIC;
+    header.version = WARM_RESTART_VERSION;
+    header.header_size = sizeof(warm_restart_header_t);
+    header.route_record_size = sizeof(routing_route_t);
+    header.arp_record_size = sizeof(warm_restart_arp_record_t);
+    header.mac_record_size = sizeof(mac_table_export_record_t);
+    header.timestamp = (uint64_t)time(NULL);
+    writer.error = fwrite(&header, sizeof(header), 1, writer.file) != 1;
+
+    status = routing_table_walk(warm_write_route, &writer);
+    header.route_count = writer.count;
+    if (status == STATUS_SUCCESS && !writer.error) {
+        writer.error = !warm_write_arp(writer.file, &header.arp_count) ||
+                       !warm_write_mac(writer.file, &header.mac_count);
+    }
+
+    if (!writer.error && (fseek(writer.file, 0, SEEK_SET) != 0 ||
+                          fwrite(&header, sizeof(header), 1, writer.file) != 1 ||
+                          fflush(writer.file) != 0 || fsync(fileno(writer.file)) != 0)) {
+        writer.error = true;
+    }
+    if (fclose(writer.file) != 0) {
+        writer.error = true;
+    }
+    if (status == STATUS_SUCCESS && writer.error) {
+        status = STATUS_FAILURE;
+    }
+    if (status == STATUS_SUCCESS && rename(tmp_path, g_warm.path) != 0) {
+        status = STATUS_FAILURE;
+    }
+    if (status != STATUS_SUCCESS) {
+        (void)unlink(tmp_path);
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Writing warm restart checkpoint %s failed: %d", g_warm.path, status);
+        return status;
+    }
+
+    result.routes = header.route_count;
+    result.arp_entries = header.arp_count;
+    result.mac_entries = header.mac_count;
+    result.elapsed_us = warm_now_us() - start_us;
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Warm restart checkpoint %s: %u routes, %u ARP and %u MAC entries in %llu us",
+             g_warm.path, result.routes, result.arp_entries, result.mac_entries,
+             (unsigned long long)result.elapsed_us);
+
+    if (stats) {
+        *stats = result;
+    }
+    return STATUS_SUCCESS;
+}
+
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static uint64_t warm_now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+/**
+ * @brief Check that a mapped checkpoint was written by this build and is complete
+ */
+static bool warm_header_valid(const warm_restart_header_t *header, size_t size) {
+    uint64_t expected;
+
+    if (header->magic != WARM_RESTART_MAGIC || header->version != WARM_RESTART_VERSION ||
+        header->header_size != sizeof(warm_restart_header_t) ||
+        header->route_record_size != sizeof(routing_route_t) ||
+        header->arp_record_size != sizeof(warm_restart_arp_record_t) ||
+        header->mac_record_size != sizeof(mac_table_export_record_t)) {
+        return false;
+    }
+
+    expected = sizeof(warm_restart_header_t) +
+               (uint64_t)header->route_count * sizeof(routing_route_t) +
+               (uint64_t)header->arp_count * sizeof(warm_restart_arp_record_t) +
+               (uint64_t)header->mac_count * sizeof(mac_table_export_record_t);
+    return expected == size;
+}
+
+/**
+ * @brief Append one route, called by the routing table walk
+ */
+static void warm_write_route(const routing_route_t *route, void *ctx) {
+    warm_writer_t *writer = (warm_writer_t *)ctx;
+
+    if (writer->error) {
+        return;
+    }
+    if (fwrite(route, sizeof(*route), 1, writer->file) != 1) {
+        writer->error = true;
+        return;
+    }
+    writer->count++;
+}
+
+/**
+ * @brief Append the resolved ARP entries
+ *
+ * Unresolved and failed entries are left out: they carry no MAC to
+ * restore. An ARP table not initialized adds no entries.
+ *
+ * @return false on a write or allocation error
+ */
+static bool warm_write_arp(FILE *file, uint32_t *count) {
+    warm_restart_arp_record_t record;
+    arp_entry_info_t *entries;
+    uint16_t num_entries = 0;
+    uint16_t i;
+    bool ok = true;
+    /* The cache may have grown past its initial size */
+    uint16_t max = CONFIG_ARP_GROW_MAX_ENTRIES > CONFIG_MAX_ARP_ENTRIES ? CONFIG_ARP_GROW_MAX_ENTRIES
+                                                                        : CONFIG_MAX_ARP_ENTRIES;
+
+    *count = 0;
+    entries = malloc(max * sizeof(*entries));
+    if (!entries) {
+        return false;
+    }
+
+    if (arp_get_all_entries(arp_table_get_instance(), entries, max, &num_entries) == STATUS_SUCCESS) {
+        for (i = 0; i < num_entries && ok; i++) {
+            if (entries[i].state == ARP_ENTRY_STATE_INCOMPLETE || entries[i].state == ARP_ENTRY_STATE_FAILED) {
+                continue;
+            }
+            memset(&record, 0, sizeof(record));
+            record.ip = entries[i].ip;
+            memcpy(record.mac, entries[i].mac.addr, MAC_ADDR_LEN);
+            record.port_index = entries[i].port_index;
+            ok = fwrite(&record, sizeof(record), 1, file) == 1;
+            *count += ok;
+        }
+    }
+
+    free(entries);
+    return ok;
+}
+
+/**
+ * @brief Append the dynamic MAC entries
+ *
+ * Static and management entries come back from the configuration.
+ *
+ * @return false on a write error
+ */
+static bool warm_write_mac(FILE *file, uint32_t *count) {
+    mac_table_export_record_t record;
+    mac_table_snapshot_t snapshot;
+    uint32_t i;
+    bool ok = true;
+
+    *count = 0;
+    if (mac_table_snapshot_create(&snapshot) != STATUS_SUCCESS) {
+        return true;
+    }
+
+    for (i = 0; i < snapshot.count && ok; i++) {
+        const mac_table_entry_t *entry = &snapshot.entries[i];
+
+        if (entry->type != MAC_ENTRY_TYPE_DYNAMIC) {
+            continue;
+        }
+        memset(&record, 0, sizeof(record));
+        memcpy(record.mac_addr, entry->mac_addr.addr, MAC_ADDR_LEN);
+        record.vlan_id = entry->vlan_id;
+        record.port_id = entry->port_id;
+        record.type = (uint8_t)entry->type;
+        record.aging = (uint8_t)entry->aging;
+        record.age_timestamp = entry->age_timestamp;
+        ok = fwrite(&record, sizeof(record), 1, file) == 1;
+        *count += ok;
+    }
+
+    mac_table_snapshot_free(&snapshot);
+    return ok;
+}
+
+/**
+ * @brief Re-learn the checkpointed ARP entries
+ */
+static void warm_restore_arp(const warm_restart_arp_record_t *records, uint32_t count, uint32_t *restored) {
+    arp_table_t *table = arp_table_get_instance();
+    ipv4_addr_t ip;
+    mac_addr_t mac;
+    uint32_t i;
+
+    *restored = 0;
+    for (i = 0; i < count; i++) {
+        ip = records[i].ip;
+        memcpy(mac.addr, records[i].mac, MAC_ADDR_LEN);
+        if (arp_add_entry(table, &ip, &mac, records[i].port_index) != STATUS_SUCCESS) {
+            /* Not initialized, nothing more will go in */
+            break;
+        }
+        (*restored)++;
+    }
+}
+
+/**
+ * @brief Re-learn the checkpointed MAC entries, as dynamic entries that age out
+ */
+static void warm_restore_mac(const mac_table_export_record_t *records, uint32_t count, uint32_t *restored) {
+    mac_addr_t mac;
+    uint32_t i;
+    status_t status;
+
+    *restored = 0;
+    for (i = 0; i < count; i++) {
+        memcpy(mac.addr, records[i].mac_addr, MAC_ADDR_LEN);
+        status = mac_table_add(mac, records[i].port_id, records[i].vlan_id, false);
+        if (status == STATUS_NOT_INITIALIZED) {
+            break;
+        }
+        *restored += status == STATUS_SUCCESS;
+    }
+}
+
+static void warm_sweep_timer_cb(event_timer_t *timer, void *arg) {
+    uint32_t removed = 0;
+
+    (void)timer;
+    (void)arg;
+    g_warm.stale_pending = false;
+    if (routing_table_sweep_stale(&removed) != STATUS_SUCCESS) {
+        LOG_ERROR(LOG_CATEGORY_SYSTEM, "Sweeping stale routes after warm restart failed");
+        return;
+    }
+    LOG_INFO(LOG_CATEGORY_SYSTEM, "Warm restart complete, %u restored routes were not refreshed", removed);
+}
+
+static void warm_checkpoint_timer_cb(event_timer_t *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+    (void)warm_restart_checkpoint(NULL);
+}
@@ -6,22 +6,208 @@
 #include "sai/sai_port.h"
 #include "sai/sai_route.h"
 #include "sai/sai_vlan.h"
+#include "sai/sai_notify.h"
 #include "common/logging.h"
 #include "common/error_codes.h"
 #include "hal/hw_resources.h"
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 
+/* Начальное число ячеек хеш-таблицы одного типа объектов (степень двойки) */
+#define SAI_DB_INITIAL_SLOTS    64
+
+/* Число записей в одном слабе */
+#define SAI_DB_SLAB_RECORDS     1024
+
+/* Пустая ячейка хеш-таблицы и конец списка свободных записей */
+#define SAI_DB_NO_RECORD        UINT32_MAX
+
+// Ячейка хеш-таблицы: OID и номер записи с данными объекта
+typedef struct {
+    sai_object_id_t oid;
+    uint32_t record;
+} sai_db_slot_t;
+
+// Объекты одного типа: хеш-таблица с открытой адресацией и слабы записей
+typedef struct {
+    sai_db_slot_t *slots;   // Линейное пробирование, без надгробий
+    uint32_t slot_mask;     // Число ячеек минус один
+    uint32_t count;         // Число объектов
+    size_t record_size;     // Размер записи, задаётся первым объектом типа
+    uint8_t **slabs;        // Слабы по SAI_DB_SLAB_RECORDS записей
+    uint32_t slab_count;
+    uint32_t records_used;  // Записи, выданные хотя бы раз
+    uint32_t free_record;   // Голова списка освобождённых записей
+} sai_db_type_t;
+
 // Глобальная структура адаптера SAI
 typedef struct {
     bool initialized;
     hw_context_t *hw_context;
-    void *internal_db;     // Внутренняя база данных для SAI объектов
+    pthread_mutex_t db_lock;                            // Защищает internal_db
+    sai_db_type_t internal_db[SAI_OBJECT_TYPE_MAX];     // Внутренняя база данных для SAI объектов
+    sai_callback_manager_t callbacks;                   // Зарегистрированные callback-функции
 } sai_adapter_context_t;
 
 static sai_adapter_context_t g_sai_adapter = {0};
 
+/**
+ * @brief Хеш OID (финализатор splitmix64)
+ */
+static inline uint32_t sai_db_hash(sai_object_id_t oid) {
+    uint64_t x = oid;
+
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return (uint32_t)x;
+}
+
+/**
+ * @brief Указатель на запись по её номеру
+ */
+static inline uint8_t *sai_db_record(const sai_db_type_t *db, uint32_t record) {
+    return db->slabs[record / SAI_DB_SLAB_RECORDS] + (size_t)(record % SAI_DB_SLAB_RECORDS) * db->record_size;
+}
+
+/**
+ * @brief Поиск ячейки объекта
+ *
+ * @return Номер ячейки или -1, если объекта нет
+ */
+static int64_t sai_db_find(const sai_db_type_t *db, sai_object_id_t oid) {
+    if (!db->slots) {
+        return -1;
+    }
+
+    for (uint32_t i = sai_db_hash(oid) & db->slot_mask;; i = (i + 1) & db->slot_mask) {
+        if (db->slots[i].record == SAI_DB_NO_RECORD) {
+            return -1;
+        }
+        if (db->slots[i].oid == oid) {
+            return i;
+        }
+    }
+}
+
+/**
+ * @brief Перестроение хеш-таблицы на новое число ячеек
+ *
+ * @param db Объекты одного типа
+ * @param slot_count Новое число ячеек, степень двойки
+ * @return sai_status_t Статус операции
+ */
+static sai_status_t sai_db_resize(sai_db_type_t *db, uint32_t slot_count) {
+    sai_db_slot_t *slots = malloc(sizeof(sai_db_slot_t) * slot_count);
+
+    if (!slots) {
+        return ERROR_MEMORY_ALLOCATION_FAILED;
+    }
+    for (uint32_t i = 0; i < slot_count; i++) {
+        slots[i].record = SAI_DB_NO_RECORD;
+    }
+
+    if (db->slots) {
+        for (uint32_t i = 0; i <= db->slot_mask; i++) {
+            if (db->slots[i].record == SAI_DB_NO_RECORD) {
+                continue;
+            }
+            uint32_t j = sai_db_hash(db->slots[i].oid) & (slot_count - 1);
+            while (slots[j].record != SAI_DB_NO_RECORD) {
+                j = (j + 1) & (slot_count - 1);
+            }
+            slots[j] = db->slots[i];
+        }
+        free(db->slots);
+    }
+
+    db->slots = slots;
+    db->slot_mask = slot_count - 1;
+    return ERROR_SUCCESS;
+}
+
+/**
+ * @brief Выделение записи из слабов
+ *
+ * Освобождённые записи используются повторно; новый слаб выделяется,
+ * только когда свободных записей нет.
+ *
+ * @return Номер записи или SAI_DB_NO_RECORD при нехватке памяти
+ */
+static uint32_t sai_db_alloc_record(sai_db_type_t *db) {
+    uint32_t record = db->free_record;
+
+    if (record != SAI_DB_NO_RECORD) {
+        memcpy(&db->free_record, sai_db_record(db, record), sizeof(uint32_t));
+        return record;
+    }
+
+    if (db->records_used == db->slab_count * SAI_DB_SLAB_RECORDS) {
+        uint8_t **slabs = realloc(db->slabs, sizeof(uint8_t *) * (db->slab_count + 1));
+        if (!slabs) {
+            return SAI_DB_NO_RECORD;
+        }
+        db->slabs = slabs;
+        db->slabs[db->slab_count] = malloc(db->record_size * SAI_DB_SLAB_RECORDS);
+        if (!db->slabs[db->slab_count]) {
+            return SAI_DB_NO_RECORD;
+        }
+        db->slab_count++;
+    }
+
+    return db->records_used++;
+}
+
+/**
+ * @brief Возврат записи в список свободных
+ */
+static void sai_db_free_record(sai_db_type_t *db, uint32_t record) {
+    memcpy(sai_db_record(db, record), &db->free_record, sizeof(uint32_t));
+    db->free_record = record;
+}
+
+/**
+ * @brief Освобождение ячейки со сдвигом следующих за ней
+ *
+ * Объекты цепочки пробирования за удалённым сдвигаются назад, поэтому
+ * надгробия не нужны и поиск не замедляется после удалений.
+ */
+static void sai_db_clear_slot(sai_db_type_t *db, uint32_t slot) {
+    uint32_t hole = slot;
+
+    for (uint32_t i = (slot + 1) & db->slot_mask; db->slots[i].record != SAI_DB_NO_RECORD;
+         i = (i + 1) & db->slot_mask) {
+        uint32_t home = sai_db_hash(db->slots[i].oid) & db->slot_mask;
+
+        /* Объект остаётся на месте, если его начальная ячейка лежит между дырой и им */
+        if (((i - home) & db->slot_mask) >= ((i - hole) & db->slot_mask)) {
+            db->slots[hole] = db->slots[i];
+            hole = i;
+        }
+    }
+    db->slots[hole].record = SAI_DB_NO_RECORD;
+}
+
+/**
+ * @brief Освобождение всех объектов всех типов
+ */
+static void sai_db_destroy(void) {
+    for (uint32_t type = 0; type < SAI_OBJECT_TYPE_MAX; type++) {
+        sai_db_type_t *db = &g_sai_adapter.internal_db[type];
+
+        for (uint32_t i = 0; i < db->slab_count; i++) {
+            free(db->slabs[i]);
+        }
+        free(db->slabs);
+        free(db->slots);
+        memset(db, 0, sizeof(*db));
+        db->free_record = SAI_DB_NO_RECORD;
+    }
+}
+
 /**
  * @brief Инициализирует адаптер SAI
  * 
@@ -42,10 +228,15 @@ sai_status_t sai_adapter_init(hw_context_t *hw_context) {
     LOG_INFO("Initializing SAI adapter");
 
     g_sai_adapter.hw_context = hw_context;
-    g_sai_adapter.internal_db = calloc(1, sizeof(void*) * 1024);  // Простая аллокация для демонстрации
     
-    if (!g_sai_adapter.internal_db) {
-        LOG_ERROR("Failed to allocate memory for SAI adapter internal database");
+    /* Таблицы объектов выделяются при сохранении первого объекта типа */
+    memset(g_sai_adapter.internal_db, 0, sizeof(g_sai_adapter.internal_db));
+    for (uint32_t type = 0; type < SAI_OBJECT_TYPE_MAX; type++) {
+        g_sai_adapter.internal_db[type].free_record = SAI_DB_NO_RECORD;
+    }
+    
+    if (pthread_mutex_init(&g_sai_adapter.db_lock, NULL) != 0) {
+        LOG_ERROR("Failed to initialize SAI adapter internal database lock");
         return ERROR_MEMORY_ALLOCATION_FAILED;
     }
 
@@ -55,7 +246,7 @@ sai_status_t sai_adapter_init(hw_context_t *hw_context) {
     result = sai_port_module_init();
     if (result != ERROR_SUCCESS) {
         LOG_ERROR("Failed to initialize SAI Port module, error: %d", result);
-        free(g_sai_adapter.internal_db);
+        pthread_mutex_destroy(&g_sai_adapter.db_lock);
         return result;
     }
 
@@ -63,7 +254,7 @@ sai_status_t sai_adapter_init(hw_context_t *hw_context) {
     if (result != ERROR_SUCCESS) {
         LOG_ERROR("Failed to initialize SAI Route module, error: %d", result);
         sai_port_module_deinit();
-        free(g_sai_adapter.internal_db);
+        pthread_mutex_destroy(&g_sai_adapter.db_lock);
         return result;
     }
 
@@ -72,7 +263,17 @@ sai_status_t sai_adapter_init(hw_context_t *hw_context) {
         LOG_ERROR("Failed to initialize SAI VLAN module, error: %d", result);
         sai_route_module_deinit();
         sai_port_module_deinit();
-        free(g_sai_adapter.internal_db);
+        pthread_mutex_destroy(&g_sai_adapter.db_lock);
+        return result;
+    }
+
+    result = sai_notify_init();
+    if (result != ERROR_SUCCESS) {
+        LOG_ERROR("Failed to initialize SAI notification channel, error: %d", result);
+        sai_vlan_module_deinit();
+        sai_route_module_deinit();
+        sai_port_module_deinit();
+        pthread_mutex_destroy(&g_sai_adapter.db_lock);
         return result;
     }
 
@@ -95,12 +296,15 @@ sai_status_t sai_adapter_deinit(void) {
     LOG_INFO("Deinitializing SAI adapter");
 
     // Деинициализация подсистем SAI в обратном порядке
+    sai_notify_deinit();
+    sai_notify_set_callbacks(NULL, NULL);
     sai_vlan_module_deinit();
     sai_route_module_deinit();
     sai_port_module_deinit();
 
     // Освобождение ресурсов
-    free(g_sai_adapter.internal_db);
+    sai_db_destroy();
+    pthread_mutex_destroy(&g_sai_adapter.db_lock);
     memset(&g_sai_adapter, 0, sizeof(g_sai_adapter));
 
     LOG_INFO("SAI adapter deinitialized successfully");
@@ -124,39 +328,75 @@ hw_context_t* sai_adapter_get_hw_context(void) {
 /**
  * @brief Сохраняет объект SAI во внутренней базе данных
  * 
+ * Объект с тем же OID заменяется на месте. Первый объект типа задаёт
+ * размер записи этого типа.
+ * 
  * @param obj_type Тип объекта
- * @param obj_id ID объекта
+ * @param obj_id OID объекта
  * @param obj_data Данные объекта
+ * @param data_size Размер данных
  * @return sai_status_t Статус сохранения объекта
  */
-sai_status_t sai_adapter_store_object(uint32_t obj_type, uint32_t obj_id, void *obj_data, size_t data_size) {
+sai_status_t sai_adapter_store_object(uint32_t obj_type, sai_object_id_t obj_id, void *obj_data, size_t data_size) {
     if (!g_sai_adapter.initialized) {
         LOG_ERROR("SAI adapter not initialized");
         return ERROR_NOT_INITIALIZED;
     }
 
-    if (!obj_data || data_size == 0 || obj_id >= 1024) {  // Простая проверка для демонстрации
+    if (!obj_data || data_size == 0 || obj_type >= SAI_OBJECT_TYPE_MAX) {
         LOG_ERROR("Invalid object parameters");
         return ERROR_INVALID_PARAMETER;
     }
 
-    void **obj_db = (void**)g_sai_adapter.internal_db;
-    
-    // Простое хранилище для демонстрации
-    // В реальной реализации требуется более сложная структура хранения
-    if (obj_db[obj_id] != NULL) {
-        free(obj_db[obj_id]);
+    pthread_mutex_lock(&g_sai_adapter.db_lock);
+    sai_db_type_t *db = &g_sai_adapter.internal_db[obj_type];
+
+    if (db->record_size == 0) {
+        /* Запись вмещает и ссылку списка свободных записей, выравнивание по 8 байт */
+        db->record_size = ((data_size < sizeof(uint32_t) ? sizeof(uint32_t) : data_size) + 7) & ~(size_t)7;
+    } else if (data_size > db->record_size) {
+        pthread_mutex_unlock(&g_sai_adapter.db_lock);
+        LOG_ERROR("SAI object of %zu bytes exceeds the %zu byte records of type %u",
+                  data_size, db->record_size, obj_type);
+        return ERROR_INVALID_PARAMETER;
     }
-    
-    obj_db[obj_id] = malloc(data_size);
-    if (!obj_db[obj_id]) {
+
+    int64_t slot = sai_db_find(db, obj_id);
+    if (slot >= 0) {
+        memcpy(sai_db_record(db, db->slots[slot].record), obj_data, data_size);
+        pthread_mutex_unlock(&g_sai_adapter.db_lock);
+        LOG_DEBUG("Updated SAI object: type=%u, id=%llu", obj_type, (unsigned long long)obj_id);
+        return ERROR_SUCCESS;
+    }
+
+    /* Заполнение таблицы не выше 3/4 */
+    if (!db->slots || (db->count + 1) * 4 > (db->slot_mask + 1) * 3) {
+        uint32_t slot_count = db->slots ? (db->slot_mask + 1) * 2 : SAI_DB_INITIAL_SLOTS;
+        if (sai_db_resize(db, slot_count) != ERROR_SUCCESS) {
+            pthread_mutex_unlock(&g_sai_adapter.db_lock);
+            LOG_ERROR("Failed to grow SAI object table of type %u", obj_type);
+            return ERROR_MEMORY_ALLOCATION_FAILED;
+        }
+    }
+
+    uint32_t record = sai_db_alloc_record(db);
+    if (record == SAI_DB_NO_RECORD) {
+        pthread_mutex_unlock(&g_sai_adapter.db_lock);
         LOG_ERROR("Failed to allocate memory for SAI object");
         return ERROR_MEMORY_ALLOCATION_FAILED;
     }
+    memcpy(sai_db_record(db, record), obj_data, data_size);
+
+    uint32_t i = sai_db_hash(obj_id) & db->slot_mask;
+    while (db->slots[i].record != SAI_DB_NO_RECORD) {
+        i = (i + 1) & db->slot_mask;
+    }
+    db->slots[i].oid = obj_id;
+    db->slots[i].record = record;
+    db->count++;
+    pthread_mutex_unlock(&g_sai_adapter.db_lock);
     
-    memcpy(obj_db[obj_id], obj_data, data_size);
-    
-    LOG_DEBUG("Stored SAI object: type=%u, id=%u", obj_type, obj_id);
+    LOG_DEBUG("Stored SAI object: type=%u, id=%llu", obj_type, (unsigned long long)obj_id);
     return ERROR_SUCCESS;
 }
 
@@ -164,31 +404,42 @@ sai_status_t sai_adapter_store_object(uint32_t obj_type, uint32_t obj_id, void *
  * @brief Получает объект SAI из внутренней базы данных
  * 
  * @param obj_type Тип объекта
- * @param obj_id ID объекта
+ * @param obj_id OID объекта
  * @param obj_data Буфер для данных объекта
+ * @param data_size Размер буфера
  * @return sai_status_t Статус получения объекта
  */
-sai_status_t sai_adapter_get_object(uint32_t obj_type, uint32_t obj_id, void *obj_data, size_t data_size) {
+sai_status_t sai_adapter_get_object(uint32_t obj_type, sai_object_id_t obj_id, void *obj_data, size_t data_size) {
     if (!g_sai_adapter.initialized) {
         LOG_ERROR("SAI adapter not initialized");
         return ERROR_NOT_INITIALIZED;
     }
 
-    if (!obj_data || data_size == 0 || obj_id >= 1024) {  // Простая проверка для демонстрации
+    if (!obj_data || data_size == 0 || obj_type >= SAI_OBJECT_TYPE_MAX) {
         LOG_ERROR("Invalid object parameters");
         return ERROR_INVALID_PARAMETER;
     }
 
-    void **obj_db = (void**)g_sai_adapter.internal_db;
+    pthread_mutex_lock(&g_sai_adapter.db_lock);
+    sai_db_type_t *db = &g_sai_adapter.internal_db[obj_type];
+    int64_t slot = sai_db_find(db, obj_id);
     
-    if (obj_db[obj_id] == NULL) {
-        LOG_ERROR("SAI object not found: type=%u, id=%u", obj_type, obj_id);
+    if (slot < 0) {
+        pthread_mutex_unlock(&g_sai_adapter.db_lock);
+        LOG_ERROR("SAI object not found: type=%u, id=%llu", obj_type, (unsigned long long)obj_id);
         return ERROR_NOT_FOUND;
     }
+
+    if (data_size > db->record_size) {
+        pthread_mutex_unlock(&g_sai_adapter.db_lock);
+        LOG_ERROR("Invalid object parameters");
+        return ERROR_INVALID_PARAMETER;
+    }
     
-    memcpy(obj_data, obj_db[obj_id], data_size);
+    memcpy(obj_data, sai_db_record(db, db->slots[slot].record), data_size);
+    pthread_mutex_unlock(&g_sai_adapter.db_lock);
     
-    LOG_DEBUG("Retrieved SAI object: type=%u, id=%u", obj_type, obj_id);
+    LOG_DEBUG("Retrieved SAI object: type=%u, id=%llu", obj_type, (unsigned long long)obj_id);
     return ERROR_SUCCESS;
 }
 
@@ -196,34 +447,58 @@ sai_status_t sai_adapter_get_object(uint32_t obj_type, uint32_t obj_id, void *ob
  * @brief Удаляет объект SAI из внутренней базы данных
  * 
  * @param obj_type Тип объекта
- * @param obj_id ID объекта
+ * @param obj_id OID объекта
  * @return sai_status_t Статус удаления объекта
  */
-sai_status_t sai_adapter_remove_object(uint32_t obj_type, uint32_t obj_id) {
+sai_status_t sai_adapter_remove_object(uint32_t obj_type, sai_object_id_t obj_id) {
     if (!g_sai_adapter.initialized) {
         LOG_ERROR("SAI adapter not initialized");
         return ERROR_NOT_INITIALIZED;
     }
 
-    if (obj_id >= 1024) {  // Простая проверка для демонстрации
-        LOG_ERROR("Invalid object ID");
+    if (obj_type >= SAI_OBJECT_TYPE_MAX) {
+        LOG_ERROR("Invalid object type");
         return ERROR_INVALID_PARAMETER;
     }
 
-    void **obj_db = (void**)g_sai_adapter.internal_db;
+    pthread_mutex_lock(&g_sai_adapter.db_lock);
+    sai_db_type_t *db = &g_sai_adapter.internal_db[obj_type];
+    int64_t slot = sai_db_find(db, obj_id);
     
-    if (obj_db[obj_id] == NULL) {
-        LOG_ERROR("SAI object not found: type=%u, id=%u", obj_type, obj_id);
+    if (slot < 0) {
+        pthread_mutex_unlock(&g_sai_adapter.db_lock);
+        LOG_ERROR("SAI object not found: type=%u, id=%llu", obj_type, (unsigned long long)obj_id);
         return ERROR_NOT_FOUND;
     }
     
-    free(obj_db[obj_id]);
-    obj_db[obj_id] = NULL;
+    sai_db_free_record(db, db->slots[slot].record);
+    sai_db_clear_slot(db, (uint32_t)slot);
+    db->count--;
+    pthread_mutex_unlock(&g_sai_adapter.db_lock);
     
-    LOG_DEBUG("Removed SAI object: type=%u, id=%u", obj_type, obj_id);
+    LOG_DEBUG("Removed SAI object: type=%u, id=%llu", obj_type, (unsigned long long)obj_id);
     return ERROR_SUCCESS;
 }
 
+/**
+ * @brief Число объектов одного типа во внутренней базе данных
+ * 
+ * @param obj_type Тип объекта
+ * @return uint32_t Число объектов
+ */
+uint32_t sai_adapter_get_object_count(uint32_t obj_type) {
+    uint32_t count;
+
+    if (!g_sai_adapter.initialized || obj_type >= SAI_OBJECT_TYPE_MAX) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&g_sai_adapter.db_lock);
+    count = g_sai_adapter.internal_db[obj_type].count;
+    pthread_mutex_unlock(&g_sai_adapter.db_lock);
+    return count;
+}
+
 
 
 
@@ -263,19 +538,94 @@ sai_status_t sai_get_performance_metrics(sai_performance_metrics_t *metrics) {
     return ERROR_NOT_IMPLEMENTED;
 }
 
+/**
+ * @brief Регистрирует callback-функции SAI
+ * 
+ * @param callbacks Callback-функции; NULL-поля отключают соответствующие
+ * @return sai_status_t Код ошибки
+ */
 sai_status_t sai_register_callbacks(const sai_callback_manager_t *callbacks) {
-    LOG_WARN("sai_register_callbacks: Not implemented yet");
-    return ERROR_NOT_IMPLEMENTED;
+    if (!callbacks) {
+        LOG_ERROR("Invalid callbacks");
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    pthread_mutex_lock(&g_sai_adapter.db_lock);
+    g_sai_adapter.callbacks = *callbacks;
+    pthread_mutex_unlock(&g_sai_adapter.db_lock);
+
+    // Уведомления FDB и портов доставляет поток уведомлений
+    sai_notify_set_callbacks(callbacks->on_fdb_event, callbacks->on_port_state_change);
+    return ERROR_SUCCESS;
 }
 
+/* Имена атрибутов порта для sai_get_attribute_advanced() */
+static const struct {
+    const char *name;
+    sai_port_attr_id_t id;
+} g_sai_port_attr_names[] = {
+    { "type",              SAI_PORT_ATTR_TYPE },
+    { "oper_status",       SAI_PORT_ATTR_OPER_STATUS },
+    { "admin_state",       SAI_PORT_ATTR_ADMIN_STATE },
+    { "media_type",        SAI_PORT_ATTR_MEDIA_TYPE },
+    { "speed",             SAI_PORT_ATTR_SPEED },
+    { "duplex",            SAI_PORT_ATTR_DUPLEX },
+    { "auto_neg_mode",     SAI_PORT_ATTR_AUTO_NEG_MODE },
+    { "flow_control_mode", SAI_PORT_ATTR_FLOW_CONTROL_MODE },
+    { "mtu",               SAI_PORT_ATTR_MTU },
+    { "internal_loopback", SAI_PORT_ATTR_INTERNAL_LOOPBACK_MODE },
+    { "fec_mode",          SAI_PORT_ATTR_FEC_MODE },
+};
+
+/**
+ * @brief Получает атрибут объекта по имени
+ * 
+ * Поддерживаются атрибуты портов; они читаются из блока атрибутов порта,
+ * см. sai_get_port_attributes(). Значение - поле объединения значений
+ * sai_port_attr_t, value_size - его размер.
+ */
 sai_status_t sai_get_attribute_advanced(sai_object_type_t object_type, 
                                     uint32_t object_id, 
                                     const char *attribute_name, 
                                     void *value,
                                     size_t *value_size) 
 {
-    LOG_WARN("sai_get_attribute_advanced: Not implemented yet");
-    return ERROR_NOT_IMPLEMENTED;
+    if (object_type != SAI_OBJECT_TYPE_PORT) {
+        LOG_WARN("sai_get_attribute_advanced: object type %d not supported", object_type);
+        return ERROR_NOT_IMPLEMENTED;
+    }
+
+    if (!attribute_name || !value || !value_size) {
+        LOG_ERROR("Invalid parameters for attribute get");
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    sai_port_attr_t attr;
+    size_t i;
+    for (i = 0; i < sizeof(g_sai_port_attr_names) / sizeof(g_sai_port_attr_names[0]); i++) {
+        if (strcmp(g_sai_port_attr_names[i].name, attribute_name) == 0) {
+            break;
+        }
+    }
+    if (i == sizeof(g_sai_port_attr_names) / sizeof(g_sai_port_attr_names[0])) {
+        LOG_ERROR("Unknown port attribute '%s'", attribute_name);
+        return ERROR_NOT_FOUND;
+    }
+
+    if (*value_size < sizeof(attr.value)) {
+        *value_size = sizeof(attr.value);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    attr.id = g_sai_port_attr_names[i].id;
+    sai_status_t status = sai_get_port_attributes(object_id, 1, &attr);
+    if (status != SAI_STATUS_SUCCESS) {
+        return status;
+    }
+
+    memcpy(value, &attr.value, sizeof(attr.value));
+    *value_size = sizeof(attr.value);
+    return ERROR_SUCCESS;
 }
 
 sai_status_t sai_set_attribute_advanced(sai_object_type_t object_type,
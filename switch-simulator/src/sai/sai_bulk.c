@@ -0,0 +1,329 @@
+/**
+ * @file sai_bulk.c
+ * @brief Реализация пакетных операций SAI над маршрутами, соседями и FDB
+ *
+ * Пакетные операции над членами VLAN реализованы в sai_vlan.c, рядом с
+ * локальной таблицей VLAN, которую они обновляют.
+ */
+
+#include "sai/sai_bulk.h"
+#include "l2/mac_table.h"
+#include "l3/arp.h"
+#include "l3/routing_table.h"
+#include "common/error_codes.h"
+#include "common/logging.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Преобразование кода нижележащего уровня в статус SAI
+ *
+ * @param status Код L2/L3
+ * @return sai_status_t Статус SAI
+ */
+static sai_status_t sai_bulk_status_from_l2(status_t status) {
+    switch ((int)status) {
+        case STATUS_SUCCESS:
+            return SAI_STATUS_SUCCESS;
+        case STATUS_INVALID_PARAMETER:
+            return SAI_STATUS_INVALID_PARAMETER;
+        case STATUS_ALREADY_EXISTS:
+            return SAI_STATUS_ITEM_ALREADY_EXISTS;
+        case STATUS_NOT_FOUND:
+            return SAI_STATUS_ITEM_NOT_FOUND;
+        case STATUS_TABLE_FULL:
+            return SAI_STATUS_TABLE_FULL;
+        case STATUS_NO_MEMORY:
+            return SAI_STATUS_INSUFFICIENT_RESOURCES;
+        case STATUS_NOT_INITIALIZED:
+            return SAI_STATUS_UNINITIALIZED;
+        case STATUS_NOT_EXECUTED:
+            return SAI_STATUS_NOT_EXECUTED;
+        default:
+            return SAI_STATUS_FAILURE;
+    }
+}
+
+/**
+ * @brief Итоговый статус пакетной операции по статусам объектов
+ *
+ * @param object_count Количество объектов
+ * @param object_statuses Статусы объектов
+ * @return sai_status_t SAI_STATUS_SUCCESS, если все объекты обработаны успешно
+ */
+static sai_status_t sai_bulk_result(uint32_t object_count, const sai_status_t *object_statuses) {
+    for (uint32_t i = 0; i < object_count; i++) {
+        if (object_statuses[i] != SAI_STATUS_SUCCESS) {
+            return SAI_STATUS_FAILURE;
+        }
+    }
+    return SAI_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Общая часть пакетного создания и удаления маршрутов
+ *
+ * Все маршруты применяются одним вызовом routing_table_update_routes():
+ * одна блокировка таблицы маршрутизации и одна фиксация FIB.
+ *
+ * @param object_count Количество маршрутов
+ * @param route_entries Маршруты
+ * @param remove Удалять маршруты вместо создания
+ * @param mode Режим обработки ошибок
+ * @param object_statuses Статусы маршрутов
+ * @return sai_status_t Статус операции
+ */
+static sai_status_t sai_bulk_route_entries(uint32_t object_count, const sai_bulk_route_entry_t *route_entries,
+                                           bool remove, sai_bulk_op_error_mode_t mode,
+                                           sai_status_t *object_statuses) {
+    if ((object_count > 0 && route_entries == NULL) || object_statuses == NULL) {
+        LOG_ERROR(LOG_CATEGORY_SAI, "Invalid parameters for bulk route operation");
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+
+    if (object_count == 0) {
+        return SAI_STATUS_SUCCESS;
+    }
+
+    routing_route_t *routes = calloc(object_count, sizeof(routing_route_t));
+    status_t *statuses = calloc(object_count, sizeof(status_t));
+    if (routes == NULL || statuses == NULL) {
+        LOG_ERROR(LOG_CATEGORY_SAI, "Failed to allocate memory for %u routes", object_count);
+        free(routes);
+        free(statuses);
+        return SAI_STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    /* Маршруты, созданные через SAI, являются статическими */
+    for (uint32_t i = 0; i < object_count; i++) {
+        routes[i].prefix = route_entries[i].destination;
+        routes[i].next_hop = route_entries[i].next_hop;
+        routes[i].type = route_entries[i].destination.type;
+        routes[i].prefix_len = route_entries[i].prefix_len;
+        routes[i].interface_index = route_entries[i].interface_index;
+        routes[i].metric = route_entries[i].metric;
+        routes[i].source = ROUTE_TYPE_STATIC;
+    }
+
+    status_t status = routing_table_update_routes(routes, object_count, remove,
+                                                  mode == SAI_BULK_OP_ERROR_MODE_STOP_ON_ERROR, statuses);
+    if (status == STATUS_NOT_INITIALIZED) {
+        /* До обработки объектов дело не дошло */
+        for (uint32_t i = 0; i < object_count; i++) {
+            statuses[i] = status;
+        }
+    }
+
+    for (uint32_t i = 0; i < object_count; i++) {
+        object_statuses[i] = sai_bulk_status_from_l2(statuses[i]);
+    }
+
+    free(routes);
+    free(statuses);
+
+    LOG_INFO(LOG_CATEGORY_SAI, "Bulk %s of %u routes, status: %d", remove ? "removal" : "creation", object_count, status);
+
+    return sai_bulk_result(object_count, object_statuses);
+}
+
+/**
+ * @brief Пакетное создание маршрутов
+ *
+ * @param object_count Количество маршрутов
+ * @param route_entries Маршруты
+ * @param mode Режим обработки ошибок
+ * @param object_statuses Статусы маршрутов
+ * @return sai_status_t Статус операции
+ */
+sai_status_t sai_bulk_create_route_entry(uint32_t object_count, const sai_bulk_route_entry_t *route_entries,
+                                         sai_bulk_op_error_mode_t mode, sai_status_t *object_statuses) {
+    return sai_bulk_route_entries(object_count, route_entries, false, mode, object_statuses);
+}
+
+/**
+ * @brief Пакетное удаление маршрутов
+ *
+ * @param object_count Количество маршрутов
+ * @param route_entries Маршруты
+ * @param mode Режим обработки ошибок
+ * @param object_statuses Статусы маршрутов
+ * @return sai_status_t Статус операции
+ */
+sai_status_t sai_bulk_remove_route_entry(uint32_t object_count, const sai_bulk_route_entry_t *route_entries,
+                                         sai_bulk_op_error_mode_t mode, sai_status_t *object_statuses) {
+    return sai_bulk_route_entries(object_count, route_entries, true, mode, object_statuses);
+}
+
+/**
+ * @brief Общая часть пакетного создания и удаления соседей
+ *
+ * Соседи передаются в таблицу своего семейства группами до ARP_BULK_MAX
+ * подряд идущих записей одного семейства; каждая группа обрабатывается
+ * под одной блокировкой таблицы.
+ *
+ * @param object_count Количество соседей
+ * @param neighbor_entries Соседи
+ * @param remove Удалять соседей вместо создания
+ * @param mode Режим обработки ошибок
+ * @param object_statuses Статусы соседей
+ * @return sai_status_t Статус операции
+ */
+static sai_status_t sai_bulk_neighbor_entries(uint32_t object_count,
+                                              const sai_bulk_neighbor_entry_t *neighbor_entries,
+                                              bool remove, sai_bulk_op_error_mode_t mode,
+                                              sai_status_t *object_statuses) {
+    arp_neighbor_t neighbors[ARP_BULK_MAX];
+    status_t statuses[ARP_BULK_MAX];
+    bool stop_on_error = (mode == SAI_BULK_OP_ERROR_MODE_STOP_ON_ERROR);
+    bool stopped = false;
+    uint32_t done = 0;
+
+    if ((object_count > 0 && neighbor_entries == NULL) || object_statuses == NULL) {
+        LOG_ERROR(LOG_CATEGORY_SAI, "Invalid parameters for bulk neighbor operation");
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+
+    while (done < object_count && !stopped) {
+        ip_addr_type_t family = neighbor_entries[done].ip_address.type;
+        arp_table_t *table = (family == IP_TYPE_V6) ? nd_table_get_instance() : arp_table_get_instance();
+        uint32_t n = 0;
+
+        /* Сбор группы подряд идущих соседей одного семейства */
+        while (done + n < object_count && n < ARP_BULK_MAX &&
+               neighbor_entries[done + n].ip_address.type == family) {
+            const sai_bulk_neighbor_entry_t *entry = &neighbor_entries[done + n];
+
+            memset(&neighbors[n], 0, sizeof(neighbors[n]));
+            if (family == IP_TYPE_V6) {
+                neighbors[n].addr.ipv6 = entry->ip_address.addr.v6;
+            } else {
+                neighbors[n].addr.ipv4 = entry->ip_address.addr.v4;
+            }
+            neighbors[n].mac = entry->mac_address;
+            neighbors[n].port_index = entry->port_index;
+            n++;
+        }
+
+        status_t status = remove ? arp_remove_neighbors_bulk(table, neighbors, n, stop_on_error, statuses)
+                                 : arp_add_neighbors_bulk(table, neighbors, n, stop_on_error, statuses);
+        if (status == STATUS_NOT_INITIALIZED) {
+            /* Таблица не обработала ни одного соседа группы */
+            for (uint32_t i = 0; i < n; i++) {
+                statuses[i] = status;
+            }
+        }
+
+        for (uint32_t i = 0; i < n; i++) {
+            object_statuses[done + i] = sai_bulk_status_from_l2(statuses[i]);
+        }
+        done += n;
+        stopped = stop_on_error && status != STATUS_SUCCESS;
+    }
+
+    /* Соседи после ошибки в режиме остановки не обрабатывались */
+    for (; done < object_count; done++) {
+        object_statuses[done] = SAI_STATUS_NOT_EXECUTED;
+    }
+
+    return sai_bulk_result(object_count, object_statuses);
+}
+
+/**
+ * @brief Пакетное создание соседей
+ *
+ * @param object_count Количество соседей
+ * @param neighbor_entries Соседи
+ * @param mode Режим обработки ошибок
+ * @param object_statuses Статусы соседей
+ * @return sai_status_t Статус операции
+ */
+sai_status_t sai_bulk_create_neighbor_entry(uint32_t object_count,
+                                            const sai_bulk_neighbor_entry_t *neighbor_entries,
+                                            sai_bulk_op_error_mode_t mode, sai_status_t *object_statuses) {
+    return sai_bulk_neighbor_entries(object_count, neighbor_entries, false, mode, object_statuses);
+}
+
+/**
+ * @brief Пакетное удаление соседей
+ *
+ * @param object_count Количество соседей
+ * @param neighbor_entries Соседи
+ * @param mode Режим обработки ошибок
+ * @param object_statuses Статусы соседей
+ * @return sai_status_t Статус операции
+ */
+sai_status_t sai_bulk_remove_neighbor_entry(uint32_t object_count,
+                                            const sai_bulk_neighbor_entry_t *neighbor_entries,
+                                            sai_bulk_op_error_mode_t mode, sai_status_t *object_statuses) {
+    return sai_bulk_neighbor_entries(object_count, neighbor_entries, true, mode, object_statuses);
+}
+
+/**
+ * @brief Общая часть пакетного создания и удаления записей FDB
+ *
+ * Таблица MAC блокирует только пару корзин каждой записи, поэтому общей
+ * блокировки на весь пакет нет: записи применяются по одной.
+ *
+ * @param object_count Количество записей
+ * @param fdb_entries Записи FDB
+ * @param remove Удалять записи вместо создания
+ * @param mode Режим обработки ошибок
+ * @param object_statuses Статусы записей
+ * @return sai_status_t Статус операции
+ */
+static sai_status_t sai_bulk_fdb_entries(uint32_t object_count, const sai_bulk_fdb_entry_t *fdb_entries,
+                                         bool remove, sai_bulk_op_error_mode_t mode,
+                                         sai_status_t *object_statuses) {
+    uint32_t i = 0;
+
+    if ((object_count > 0 && fdb_entries == NULL) || object_statuses == NULL) {
+        LOG_ERROR(LOG_CATEGORY_SAI, "Invalid parameters for bulk FDB operation");
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+
+    while (i < object_count) {
+        const sai_bulk_fdb_entry_t *entry = &fdb_entries[i];
+        status_t status = remove ? mac_table_remove(entry->mac_address, entry->vlan_id)
+                                 : mac_table_add(entry->mac_address, entry->port_id, entry->vlan_id,
+                                                 entry->is_static);
+
+        object_statuses[i++] = sai_bulk_status_from_l2(status);
+        if (status != STATUS_SUCCESS && mode == SAI_BULK_OP_ERROR_MODE_STOP_ON_ERROR) {
+            break;
+        }
+    }
+
+    for (; i < object_count; i++) {
+        object_statuses[i] = SAI_STATUS_NOT_EXECUTED;
+    }
+
+    return sai_bulk_result(object_count, object_statuses);
+}
+
+/**
+ * @brief Пакетное создание записей FDB
+ *
+ * @param object_count Количество записей
+ * @param fdb_entries Записи FDB
+ * @param mode Режим обработки ошибок
+ * @param object_statuses Статусы записей
+ * @return sai_status_t Статус операции
+ */
+sai_status_t sai_bulk_create_fdb_entry(uint32_t object_count, const sai_bulk_fdb_entry_t *fdb_entries,
+                                       sai_bulk_op_error_mode_t mode, sai_status_t *object_statuses) {
+    return sai_bulk_fdb_entries(object_count, fdb_entries, false, mode, object_statuses);
+}
+
+/**
+ * @brief Пакетное удаление записей FDB
+ *
+ * @param object_count Количество записей
+ * @param fdb_entries Записи FDB
+ * @param mode Режим обработки ошибок
+ * @param object_statuses Статусы записей
+ * @return sai_status_t Статус операции
+ */
+sai_status_t sai_bulk_remove_fdb_entry(uint32_t object_count, const sai_bulk_fdb_entry_t *fdb_entries,
+                                       sai_bulk_op_error_mode_t mode, sai_status_t *object_statuses) {
+    return sai_bulk_fdb_entries(object_count, fdb_entries, true, mode, object_statuses);
+}
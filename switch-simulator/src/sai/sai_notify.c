@@ -0,0 +1,404 @@
+/**
+ * @file sai_notify.c
+ * @brief Асинхронные уведомления SAI о событиях FDB и состоянии портов
+ *
+ * Производители (потоки изучения MAC, старения и портов) кладут события в
+ * кольцо без блокировок: у каждой ячейки свой счётчик последовательности,
+ * производитель занимает позицию CAS-ом хвоста. Единственный потребитель -
+ * поток уведомлений.
+ */
+
+#include "sai/sai_notify.h"
+#include "l2/mac_table.h"
+#include "hal/hw_simulation.h"
+#include "common/config.h"
+#include "common/error_codes.h"
+#include "common/logging.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if (CONFIG_SAI_NOTIFY_RING_SIZE & (CONFIG_SAI_NOTIFY_RING_SIZE - 1)) != 0
+#error "CONFIG_SAI_NOTIFY_RING_SIZE must be a power of two"
+#endif
+
+/* Ячеек хеша свёртки FDB на пачку (степень двойки, не меньше 2 * пачка) */
+#define SAI_NOTIFY_HASH_SLOTS   (2 * CONFIG_SAI_NOTIFY_BATCH)
+
+/* Пустая ячейка хеша свёртки */
+#define SAI_NOTIFY_NO_INDEX     UINT32_MAX
+
+// Вид события в кольце
+typedef enum {
+    SAI_NOTIFY_FDB,
+    SAI_NOTIFY_PORT
+} sai_notify_kind_t;
+
+// Событие в кольце
+typedef struct {
+    uint8_t kind;               // sai_notify_kind_t
+    uint8_t fdb_event;          // sai_fdb_event_t для SAI_NOTIFY_FDB
+    port_id_t port_id;
+    vlan_id_t vlan_id;
+    port_state_t port_state;    // Для SAI_NOTIFY_PORT
+    mac_addr_t mac;
+} sai_notify_event_t;
+
+// Ячейка кольца: позиция + 1, когда событие записано, позиция + размер, когда прочитано
+typedef struct {
+    uint64_t seq;
+    sai_notify_event_t event;
+} sai_notify_cell_t;
+
+// Контекст канала уведомлений
+typedef struct {
+    bool initialized;
+    bool running;
+    pthread_t thread;
+    sai_notify_cell_t *cells;
+    uint64_t tail __attribute__((aligned(64)));     // Следующая позиция производителей
+    uint64_t head __attribute__((aligned(64)));     // Следующая позиция потребителя
+    sai_fdb_event_notification_callback fdb_callback;
+    sai_port_state_change_callback port_callback;
+    sai_notify_stats_t stats;
+    // Буферы пачки, только для потока уведомлений
+    sai_fdb_event_notification_data_t fdb_batch[CONFIG_SAI_NOTIFY_BATCH];
+    bool fdb_live[CONFIG_SAI_NOTIFY_BATCH];
+    bool fdb_learned_first[CONFIG_SAI_NOTIFY_BATCH];   // Первое событие записи в пачке - изучение
+    uint32_t fdb_hash[SAI_NOTIFY_HASH_SLOTS];
+    sai_port_oper_status_notification_t port_batch[CONFIG_SAI_NOTIFY_BATCH];
+} sai_notify_context_t;
+
+static sai_notify_context_t g_sai_notify = {0};
+
+/**
+ * @brief Кладёт событие в кольцо; при заполненном кольце событие теряется
+ */
+static void sai_notify_post(const sai_notify_event_t *event) {
+    const uint64_t mask = CONFIG_SAI_NOTIFY_RING_SIZE - 1;
+    uint64_t pos = __atomic_load_n(&g_sai_notify.tail, __ATOMIC_RELAXED);
+    sai_notify_cell_t *cell;
+
+    for (;;) {
+        cell = &g_sai_notify.cells[pos & mask];
+        int64_t diff = (int64_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&g_sai_notify.tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Потребитель не успел освободить ячейку круг назад
+            __atomic_fetch_add(&g_sai_notify.stats.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&g_sai_notify.tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->event = *event;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&g_sai_notify.stats.posted, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Достаёт событие из кольца
+ *
+ * @return true, если событие было
+ */
+static bool sai_notify_take(sai_notify_event_t *event) {
+    uint64_t pos = g_sai_notify.head;
+    sai_notify_cell_t *cell = &g_sai_notify.cells[pos & (CONFIG_SAI_NOTIFY_RING_SIZE - 1)];
+
+    if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+        return false;
+    }
+
+    *event = cell->event;
+    __atomic_store_n(&cell->seq, pos + CONFIG_SAI_NOTIFY_RING_SIZE, __ATOMIC_RELEASE);
+    g_sai_notify.head = pos + 1;
+    return true;
+}
+
+/**
+ * @brief Подписчик таблицы MAC: изучение, смена порта и старение записей
+ */
+static void sai_notify_mac_event(mac_table_entry_t *entry, bool is_added, void *user_data) {
+    (void)user_data;
+
+    sai_notify_event_t event = {
+        .kind = SAI_NOTIFY_FDB,
+        .fdb_event = is_added ? SAI_FDB_EVENT_LEARNED : SAI_FDB_EVENT_AGED,
+        .port_id = entry->port_id,
+        .vlan_id = entry->vlan_id,
+        .mac = entry->mac_addr,
+    };
+    sai_notify_post(&event);
+}
+
+/**
+ * @brief Подписчик портов: смена состояния канала
+ */
+static void sai_notify_link_event(port_id_t port_id, port_state_t state, void *user_data) {
+    (void)user_data;
+
+    sai_notify_event_t event = {
+        .kind = SAI_NOTIFY_PORT,
+        .port_id = port_id,
+        .port_state = state,
+    };
+    sai_notify_post(&event);
+}
+
+/**
+ * @brief Хеш ключа FDB для свёртки пачки
+ */
+static inline uint32_t sai_notify_fdb_hash(const mac_addr_t *mac, vlan_id_t vlan_id) {
+    uint64_t key = vlan_id;
+
+    for (int i = 0; i < MAC_ADDR_LEN; i++) {
+        key = (key << 8) | mac->addr[i];
+    }
+    key *= 0x9e3779b97f4a7c15ULL;
+    return (uint32_t)(key >> 32) & (SAI_NOTIFY_HASH_SLOTS - 1);
+}
+
+/**
+ * @brief Добавляет событие FDB в пачку, сворачивая его с прежним событием той же записи
+ *
+ * Запись, изученная в этой пачке и устаревшая в ней же, не сообщается
+ * совсем; иначе последнее событие записи заменяет прежнее. Изучением
+ * считается и смена порта: запись, только что замеченная на порту,
+ * стареет не раньше чем через время старения, поэтому в одну пачку с
+ * устареванием она попадает, лишь если поток отстал на это время.
+ *
+ * @return Число событий пачки, включая это
+ */
+static uint32_t sai_notify_add_fdb(const sai_notify_event_t *event, uint32_t count) {
+    uint32_t slot = sai_notify_fdb_hash(&event->mac, event->vlan_id);
+
+    for (; g_sai_notify.fdb_hash[slot] != SAI_NOTIFY_NO_INDEX; slot = (slot + 1) & (SAI_NOTIFY_HASH_SLOTS - 1)) {
+        uint32_t i = g_sai_notify.fdb_hash[slot];
+        sai_fdb_event_notification_data_t *prev = &g_sai_notify.fdb_batch[i];
+
+        if (prev->vlan_id != event->vlan_id || memcmp(&prev->mac_address, &event->mac, sizeof(mac_addr_t)) != 0) {
+            continue;
+        }
+
+        if (g_sai_notify.fdb_live[i] && g_sai_notify.fdb_learned_first[i] &&
+            event->fdb_event == SAI_FDB_EVENT_AGED) {
+            // NOS не узнал о записи: не сообщаем ни изучение, ни старение
+            g_sai_notify.fdb_live[i] = false;
+            __atomic_fetch_add(&g_sai_notify.stats.coalesced, 2, __ATOMIC_RELAXED);
+            return count;
+        }
+        __atomic_fetch_add(&g_sai_notify.stats.coalesced, g_sai_notify.fdb_live[i] ? 1 : 0, __ATOMIC_RELAXED);
+        prev->event_type = (sai_fdb_event_t)event->fdb_event;
+        prev->port_id = event->port_id;
+        g_sai_notify.fdb_live[i] = true;
+        return count;
+    }
+
+    sai_fdb_event_notification_data_t *data = &g_sai_notify.fdb_batch[count];
+    data->event_type = (sai_fdb_event_t)event->fdb_event;
+    data->mac_address = event->mac;
+    data->vlan_id = event->vlan_id;
+    data->port_id = event->port_id;
+    g_sai_notify.fdb_live[count] = true;
+    g_sai_notify.fdb_learned_first[count] = event->fdb_event == SAI_FDB_EVENT_LEARNED;
+    g_sai_notify.fdb_hash[slot] = count;
+    return count + 1;
+}
+
+/**
+ * @brief Добавляет событие порта в пачку; последнее состояние порта заменяет прежнее
+ *
+ * @return Число событий портов пачки, включая это
+ */
+static uint32_t sai_notify_add_port(const sai_notify_event_t *event, uint32_t count) {
+    // Смены состояния портов редки, линейного поиска достаточно
+    for (uint32_t i = 0; i < count; i++) {
+        if (g_sai_notify.port_batch[i].port_id == event->port_id) {
+            g_sai_notify.port_batch[i].port_state = event->port_state;
+            __atomic_fetch_add(&g_sai_notify.stats.coalesced, 1, __ATOMIC_RELAXED);
+            return count;
+        }
+    }
+
+    g_sai_notify.port_batch[count].port_id = event->port_id;
+    g_sai_notify.port_batch[count].port_state = event->port_state;
+    return count + 1;
+}
+
+/**
+ * @brief Собирает, сворачивает и доставляет одну пачку
+ *
+ * @return Число событий, взятых из кольца
+ */
+static uint32_t sai_notify_deliver_batch(void) {
+    sai_notify_event_t event;
+    uint32_t taken = 0;
+    uint32_t fdb_count = 0;
+    uint32_t port_count = 0;
+
+    memset(g_sai_notify.fdb_hash, 0xff, sizeof(g_sai_notify.fdb_hash));
+
+    while (taken < CONFIG_SAI_NOTIFY_BATCH && sai_notify_take(&event)) {
+        taken++;
+        if (event.kind == SAI_NOTIFY_FDB) {
+            fdb_count = sai_notify_add_fdb(&event, fdb_count);
+        } else {
+            port_count = sai_notify_add_port(&event, port_count);
+        }
+    }
+
+    if (taken == 0) {
+        return 0;
+    }
+
+    // Удаляем отменённые события, сохраняя порядок остальных
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < fdb_count; i++) {
+        if (g_sai_notify.fdb_live[i]) {
+            g_sai_notify.fdb_batch[live++] = g_sai_notify.fdb_batch[i];
+        }
+    }
+
+    sai_fdb_event_notification_callback fdb_callback =
+        __atomic_load_n(&g_sai_notify.fdb_callback, __ATOMIC_ACQUIRE);
+    sai_port_state_change_callback port_callback =
+        __atomic_load_n(&g_sai_notify.port_callback, __ATOMIC_ACQUIRE);
+    uint64_t delivered = 0;
+
+    if (live > 0 && fdb_callback) {
+        fdb_callback(live, g_sai_notify.fdb_batch);
+        delivered += live;
+    }
+    if (port_count > 0 && port_callback) {
+        port_callback(port_count, g_sai_notify.port_batch);
+        delivered += port_count;
+    }
+
+    __atomic_fetch_add(&g_sai_notify.stats.delivered, delivered, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_sai_notify.stats.batches, 1, __ATOMIC_RELAXED);
+    return taken;
+}
+
+/**
+ * @brief Поток уведомлений
+ *
+ * Выбирает кольцо пачками, пока оно не опустеет, затем спит
+ * CONFIG_SAI_NOTIFY_INTERVAL_MS: за это время набирается следующая пачка.
+ */
+static void *sai_notify_thread(void *arg) {
+    (void)arg;
+    const struct timespec interval = {
+        .tv_sec = CONFIG_SAI_NOTIFY_INTERVAL_MS / 1000,
+        .tv_nsec = (CONFIG_SAI_NOTIFY_INTERVAL_MS % 1000) * 1000000L,
+    };
+
+    while (__atomic_load_n(&g_sai_notify.running, __ATOMIC_ACQUIRE)) {
+        while (sai_notify_deliver_batch() == CONFIG_SAI_NOTIFY_BATCH) {
+        }
+        nanosleep(&interval, NULL);
+    }
+
+    // Доставляем оставшееся после отписки производителей
+    while (sai_notify_deliver_batch() > 0) {
+    }
+    return NULL;
+}
+
+/**
+ * @brief Запускает канал уведомлений
+ *
+ * @return sai_status_t Статус SAI
+ */
+sai_status_t sai_notify_init(void) {
+    if (g_sai_notify.initialized) {
+        LOG_WARNING(LOG_CATEGORY_SAI, "SAI notification channel already initialized");
+        return SAI_STATUS_ITEM_ALREADY_EXISTS;
+    }
+
+    g_sai_notify.cells = calloc(CONFIG_SAI_NOTIFY_RING_SIZE, sizeof(sai_notify_cell_t));
+    if (!g_sai_notify.cells) {
+        LOG_ERROR(LOG_CATEGORY_SAI, "Failed to allocate SAI notification ring");
+        return SAI_STATUS_INSUFFICIENT_RESOURCES;
+    }
+    for (uint64_t i = 0; i < CONFIG_SAI_NOTIFY_RING_SIZE; i++) {
+        g_sai_notify.cells[i].seq = i;
+    }
+    g_sai_notify.head = 0;
+    g_sai_notify.tail = 0;
+    memset(&g_sai_notify.stats, 0, sizeof(g_sai_notify.stats));
+
+    g_sai_notify.running = true;
+    if (pthread_create(&g_sai_notify.thread, NULL, sai_notify_thread, NULL) != 0) {
+        LOG_ERROR(LOG_CATEGORY_SAI, "Failed to start SAI notification thread");
+        g_sai_notify.running = false;
+        free(g_sai_notify.cells);
+        g_sai_notify.cells = NULL;
+        return SAI_STATUS_FAILURE;
+    }
+
+    mac_table_register_event_callback(sai_notify_mac_event, NULL);
+    hw_sim_register_link_callback(sai_notify_link_event, NULL);
+
+    g_sai_notify.initialized = true;
+    LOG_INFO(LOG_CATEGORY_SAI, "SAI notification channel started");
+    return SAI_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Останавливает канал уведомлений
+ *
+ * @return sai_status_t Статус SAI
+ */
+sai_status_t sai_notify_deinit(void) {
+    if (!g_sai_notify.initialized) {
+        return SAI_STATUS_UNINITIALIZED;
+    }
+
+    mac_table_unregister_event_callback();
+    hw_sim_register_link_callback(NULL, NULL);
+
+    __atomic_store_n(&g_sai_notify.running, false, __ATOMIC_RELEASE);
+    pthread_join(g_sai_notify.thread, NULL);
+
+    free(g_sai_notify.cells);
+    g_sai_notify.cells = NULL;
+    g_sai_notify.initialized = false;
+
+    LOG_INFO(LOG_CATEGORY_SAI, "SAI notification channel stopped");
+    return SAI_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Задаёт callback-функции доставки пачек
+ */
+void sai_notify_set_callbacks(sai_fdb_event_notification_callback fdb_callback,
+                              sai_port_state_change_callback port_callback) {
+    __atomic_store_n(&g_sai_notify.fdb_callback, fdb_callback, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_sai_notify.port_callback, port_callback, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Возвращает счётчики канала уведомлений
+ *
+ * @param stats Указатель для сохранения счётчиков
+ * @return sai_status_t Статус SAI
+ */
+sai_status_t sai_notify_get_stats(sai_notify_stats_t *stats) {
+    if (!stats) {
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+
+    stats->posted = __atomic_load_n(&g_sai_notify.stats.posted, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&g_sai_notify.stats.dropped, __ATOMIC_RELAXED);
+    stats->coalesced = __atomic_load_n(&g_sai_notify.stats.coalesced, __ATOMIC_RELAXED);
+    stats->delivered = __atomic_load_n(&g_sai_notify.stats.delivered, __ATOMIC_RELAXED);
+    stats->batches = __atomic_load_n(&g_sai_notify.stats.batches, __ATOMIC_RELAXED);
+    return SAI_STATUS_SUCCESS;
+}
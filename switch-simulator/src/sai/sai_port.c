@@ -9,14 +9,28 @@
 #include "common/types.h"
 #include "hal/port.h"
 #include "hal/hw_resources.h"
+#include "hal/hw_simulation.h"
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Блок атрибутов порта, готовых к копированию
+typedef struct {
+    uint32_t seq;                               // Нечётно, пока блок перестраивается
+    bool valid;
+    uint32_t hw_version;                        // Версия порта в HAL, по которой построен блок
+    uint32_t config_version;                    // Версия конфигурации SAI, по которой построен блок
+    sai_port_attr_t attrs[SAI_PORT_ATTR_MAX];   // По идентификатору атрибута
+} sai_port_attr_cache_t;
+
 // Определения типов для модуля портов SAI
 typedef struct {
     bool initialized;
     uint32_t port_count;
     sai_port_config_t *port_configs;
+    uint32_t *config_versions;              // Меняются при каждом изменении конфигурации порта в SAI
+    sai_port_attr_cache_t *attr_cache;      // Блоки атрибутов по порту
+    pthread_mutex_t cache_lock;             // Сериализует перестроение блоков
 } sai_port_context_t;
 
 // Глобальный контекст портов SAI
@@ -51,10 +65,16 @@ error_code_t sai_port_module_init(void) {
         return ERROR_INTERNAL;
     }
     
-    // Выделение памяти под конфигурации портов
+    // Выделение памяти под конфигурации портов и блоки атрибутов
     g_sai_port_ctx.port_configs = calloc(port_count, sizeof(sai_port_config_t));
-    if (!g_sai_port_ctx.port_configs) {
+    g_sai_port_ctx.config_versions = calloc(port_count, sizeof(uint32_t));
+    g_sai_port_ctx.attr_cache = calloc(port_count, sizeof(sai_port_attr_cache_t));
+    if (!g_sai_port_ctx.port_configs || !g_sai_port_ctx.config_versions || !g_sai_port_ctx.attr_cache) {
         LOG_ERROR("Failed to allocate memory for port configurations");
+        free(g_sai_port_ctx.port_configs);
+        free(g_sai_port_ctx.config_versions);
+        free(g_sai_port_ctx.attr_cache);
+        memset(&g_sai_port_ctx, 0, sizeof(g_sai_port_ctx));
         return ERROR_MEMORY_ALLOCATION_FAILED;
     }
     
@@ -65,7 +85,9 @@ error_code_t sai_port_module_init(void) {
         if (result != ERROR_SUCCESS) {
             LOG_ERROR("Failed to get port info for port %u", i);
             free(g_sai_port_ctx.port_configs);
-            g_sai_port_ctx.port_configs = NULL;
+            free(g_sai_port_ctx.config_versions);
+            free(g_sai_port_ctx.attr_cache);
+            memset(&g_sai_port_ctx, 0, sizeof(g_sai_port_ctx));
             return result;
         }
         
@@ -80,6 +102,7 @@ error_code_t sai_port_module_init(void) {
         g_sai_port_ctx.port_configs[i].name[MAX_PORT_NAME_LEN - 1] = '\0';
     }
     
+    pthread_mutex_init(&g_sai_port_ctx.cache_lock, NULL);
     g_sai_port_ctx.port_count = port_count;
     g_sai_port_ctx.initialized = true;
     
@@ -102,6 +125,9 @@ error_code_t sai_port_module_deinit(void) {
     
     // Освобождение ресурсов
     free(g_sai_port_ctx.port_configs);
+    free(g_sai_port_ctx.config_versions);
+    free(g_sai_port_ctx.attr_cache);
+    pthread_mutex_destroy(&g_sai_port_ctx.cache_lock);
     memset(&g_sai_port_ctx, 0, sizeof(g_sai_port_ctx));
     
     LOG_INFO("SAI Port module deinitialized successfully");
@@ -140,6 +166,7 @@ error_code_t sai_port_create(uint32_t port_id, const sai_port_config_t *port_con
     // Копирование конфигурации
     memcpy(&g_sai_port_ctx.port_configs[port_id], port_config, sizeof(sai_port_config_t));
     g_sai_port_ctx.port_configs[port_id].port_id = port_id;  // Убедимся, что ID правильный
+    __atomic_add_fetch(&g_sai_port_ctx.config_versions[port_id], 1, __ATOMIC_RELEASE);
     
     // Применение конфигурации в HAL
     hal_port_config_t hal_config;
@@ -209,6 +236,7 @@ error_code_t sai_port_remove(uint32_t port_id) {
     // Сбрасываем конфигурацию порта
     memset(&g_sai_port_ctx.port_configs[port_id], 0, sizeof(sai_port_config_t));
     g_sai_port_ctx.port_configs[port_id].port_id = port_id;
+    __atomic_add_fetch(&g_sai_port_ctx.config_versions[port_id], 1, __ATOMIC_RELEASE);
     
     // Удаление объекта из адаптера SAI
     result = sai_adapter_remove_object(SAI_OBJECT_TYPE_PORT, port_id);
@@ -291,6 +319,7 @@ error_code_t sai_port_set_config(uint32_t port_id, const sai_port_config_t *port
     // Обновление внутренней конфигурации
     memcpy(&g_sai_port_ctx.port_configs[port_id], port_config, sizeof(sai_port_config_t));
     g_sai_port_ctx.port_configs[port_id].port_id = port_id;  // Убедимся, что ID правильный
+    __atomic_add_fetch(&g_sai_port_ctx.config_versions[port_id], 1, __ATOMIC_RELEASE);
     
     // Обновление в адаптере SAI
     result = sai_adapter_store_object(SAI_OBJECT_TYPE_PORT, port_id, 
@@ -325,11 +354,10 @@ error_code_t sai_port_get_stats(uint32_t port_id, sai_port_stats_t *stats) {
 
     LOG_DEBUG("Getting SAI port %u statistics", port_id);
     
-    // Получение статистики из HAL
-    hw_context_t *hw_ctx = sai_adapter_get_hw_context();
-    hal_port_stats_t hal_stats;
+    // Счётчики HAL, свёрнутые из счётчиков потоков
+    port_stats_t hal_stats;
     
-    error_code_t result = hal_port_get_stats(hw_ctx, port_id, &hal_stats);
+    error_code_t result = port_get_stats((port_id_t)port_id, &hal_stats);
     if (result != ERROR_SUCCESS) {
         LOG_ERROR("Failed to get port %u statistics from hardware", port_id);
         return result;
@@ -402,3 +430,230 @@ error_code_t sai_port_get_count(uint32_t *count) {
     LOG_DEBUG("SAI port count: %u", *count);
     return ERROR_SUCCESS;
 }
+
+/**
+ * @brief Преобразование скорости HAL в скорость SAI
+ */
+static sai_port_speed_t sai_port_speed_from_hal(port_speed_t speed) {
+    switch (speed) {
+        case PORT_SPEED_10M:  return SAI_PORT_SPEED_10;
+        case PORT_SPEED_100M: return SAI_PORT_SPEED_100;
+        case PORT_SPEED_1G:   return SAI_PORT_SPEED_1000;
+        case PORT_SPEED_10G:  return SAI_PORT_SPEED_10000;
+        case PORT_SPEED_25G:  return SAI_PORT_SPEED_25000;
+        case PORT_SPEED_40G:  return SAI_PORT_SPEED_40000;
+        case PORT_SPEED_100G: return SAI_PORT_SPEED_100000;
+        default:              return SAI_PORT_SPEED_UNKNOWN;
+    }
+}
+
+/**
+ * @brief Преобразование рабочего состояния HAL в статус SAI
+ */
+static sai_port_oper_status_t sai_port_oper_status_from_hal(port_state_t state) {
+    switch (state) {
+        case PORT_STATE_UP:      return SAI_PORT_OPER_STATUS_UP;
+        case PORT_STATE_DOWN:    return SAI_PORT_OPER_STATUS_DOWN;
+        case PORT_STATE_TESTING: return SAI_PORT_OPER_STATUS_TESTING;
+        default:                 return SAI_PORT_OPER_STATUS_UNKNOWN;
+    }
+}
+
+/**
+ * @brief Перестраивает блок атрибутов порта по HAL
+ *
+ * Вызывается под cache_lock. Версии читаются до состояния порта: изменение,
+ * пришедшее во время перестроения, сделает блок устаревшим, а не потеряется.
+ *
+ * @param port_id ID порта
+ * @return sai_status_t Статус SAI
+ */
+static sai_status_t sai_port_attr_cache_rebuild(uint32_t port_id) {
+    sai_port_attr_cache_t *cache = &g_sai_port_ctx.attr_cache[port_id];
+    uint32_t hw_version = hw_sim_get_port_version((port_id_t)port_id);
+    uint32_t config_version = __atomic_load_n(&g_sai_port_ctx.config_versions[port_id], __ATOMIC_ACQUIRE);
+    port_config_t config;
+    port_state_t state;
+
+    if (hw_sim_get_port_config((port_id_t)port_id, &config) != STATUS_SUCCESS ||
+        hw_sim_get_port_state((port_id_t)port_id, &state) != STATUS_SUCCESS) {
+        LOG_ERROR("Failed to read port %u from hardware", port_id);
+        return SAI_STATUS_FAILURE;
+    }
+
+    __atomic_store_n(&cache->seq, cache->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memset(cache->attrs, 0, sizeof(cache->attrs));
+    for (uint32_t id = 0; id < SAI_PORT_ATTR_MAX; id++) {
+        cache->attrs[id].id = (sai_port_attr_id_t)id;
+    }
+    cache->attrs[SAI_PORT_ATTR_TYPE].value.type =
+        (port_id_t)port_id == port_cpu_id() ? SAI_PORT_TYPE_CPU : SAI_PORT_TYPE_LOGICAL;
+    cache->attrs[SAI_PORT_ATTR_OPER_STATUS].value.oper_status = sai_port_oper_status_from_hal(state);
+    cache->attrs[SAI_PORT_ATTR_ADMIN_STATE].value.admin_state =
+        config.admin_state ? SAI_PORT_ADMIN_STATE_UP : SAI_PORT_ADMIN_STATE_DOWN;
+    cache->attrs[SAI_PORT_ATTR_MEDIA_TYPE].value.media_type = SAI_PORT_MEDIA_TYPE_COPPER;
+    cache->attrs[SAI_PORT_ATTR_SPEED].value.speed = sai_port_speed_from_hal(config.speed);
+    cache->attrs[SAI_PORT_ATTR_DUPLEX].value.duplex = (sai_port_duplex_t)config.duplex;
+    cache->attrs[SAI_PORT_ATTR_AUTO_NEG_MODE].value.auto_neg = config.auto_neg;
+    cache->attrs[SAI_PORT_ATTR_FLOW_CONTROL_MODE].value.flow_control =
+        config.flow_control ? SAI_PORT_FLOW_CONTROL_BOTH_ENABLE : SAI_PORT_FLOW_CONTROL_DISABLE;
+    cache->attrs[SAI_PORT_ATTR_MTU].value.mtu = config.mtu;
+    cache->attrs[SAI_PORT_ATTR_INTERNAL_LOOPBACK_MODE].value.internal_loopback = config.mode == PORT_MODE_LOOPBACK;
+    cache->attrs[SAI_PORT_ATTR_FEC_MODE].value.fec_mode = false;
+    cache->hw_version = hw_version;
+    cache->config_version = config_version;
+    cache->valid = true;
+
+    __atomic_store_n(&cache->seq, cache->seq + 1, __ATOMIC_RELEASE);
+    return SAI_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Копирует атрибуты из блока, если он актуален
+ *
+ * Без блокировок: блок читается под счётчиком последовательности и
+ * перечитывается, если во время копирования его перестраивали.
+ *
+ * @return true, если атрибуты скопированы
+ */
+static bool sai_port_attr_cache_copy(uint32_t port_id, uint32_t attr_count, sai_port_attr_t *attr_list) {
+    const sai_port_attr_cache_t *cache = &g_sai_port_ctx.attr_cache[port_id];
+    uint32_t seq = __atomic_load_n(&cache->seq, __ATOMIC_ACQUIRE);
+
+    if ((seq & 1) || !cache->valid ||
+        cache->hw_version != hw_sim_get_port_version((port_id_t)port_id) ||
+        cache->config_version != __atomic_load_n(&g_sai_port_ctx.config_versions[port_id], __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < attr_count; i++) {
+        attr_list[i].value = cache->attrs[attr_list[i].id].value;
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&cache->seq, __ATOMIC_RELAXED) == seq;
+}
+
+/**
+ * @brief Получает атрибуты порта
+ *
+ * Атрибуты берутся из блока порта, который перестраивается только после
+ * изменения конфигурации или состояния канала; в остальное время чтение -
+ * это копирование без блокировок.
+ *
+ * @param port_id ID порта
+ * @param attr_count Количество атрибутов
+ * @param attr_list Атрибуты; поле id задаёт атрибут
+ * @return sai_status_t Статус SAI
+ */
+sai_status_t sai_get_port_attributes(sai_port_id_t port_id, uint32_t attr_count, sai_port_attr_t *attr_list) {
+    if (!g_sai_port_ctx.initialized) {
+        LOG_ERROR("SAI Port module not initialized");
+        return SAI_STATUS_UNINITIALIZED;
+    }
+
+    if (port_id >= g_sai_port_ctx.port_count || (attr_count > 0 && !attr_list)) {
+        LOG_ERROR("Invalid port ID or attribute list");
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+
+    for (uint32_t i = 0; i < attr_count; i++) {
+        if (attr_list[i].id >= SAI_PORT_ATTR_MAX) {
+            return SAI_STATUS_UNKNOWN_ATTRIBUTE;
+        }
+        if (attr_list[i].id == SAI_PORT_ATTR_HW_LANE_LIST) {
+            return SAI_STATUS_ATTR_NOT_SUPPORTED;
+        }
+    }
+
+    if (sai_port_attr_cache_copy(port_id, attr_count, attr_list)) {
+        return SAI_STATUS_SUCCESS;
+    }
+
+    // Блок устарел: перестраиваем и копируем под блокировкой
+    pthread_mutex_lock(&g_sai_port_ctx.cache_lock);
+    sai_status_t status = SAI_STATUS_SUCCESS;
+    if (!sai_port_attr_cache_copy(port_id, attr_count, attr_list)) {
+        status = sai_port_attr_cache_rebuild(port_id);
+        if (status == SAI_STATUS_SUCCESS) {
+            for (uint32_t i = 0; i < attr_count; i++) {
+                attr_list[i].value = g_sai_port_ctx.attr_cache[port_id].attrs[attr_list[i].id].value;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_sai_port_ctx.cache_lock);
+
+    return status;
+}
+
+/**
+ * @brief Получает рабочее состояние порта
+ *
+ * @param port_id ID порта
+ * @param oper_status Указатель для сохранения состояния
+ * @return sai_status_t Статус SAI
+ */
+sai_status_t sai_get_port_state(sai_port_id_t port_id, sai_port_oper_status_t *oper_status) {
+    if (!oper_status) {
+        LOG_ERROR("Invalid oper_status pointer");
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+
+    sai_port_attr_t attr = { .id = SAI_PORT_ATTR_OPER_STATUS };
+    sai_status_t status = sai_get_port_attributes(port_id, 1, &attr);
+    if (status == SAI_STATUS_SUCCESS) {
+        *oper_status = attr.value.oper_status;
+    }
+    return status;
+}
+
+/**
+ * @brief Получает счётчики порта по идентификаторам
+ *
+ * Все счётчики берутся из одной свёртки счётчиков потоков.
+ *
+ * @param port_id ID порта
+ * @param counter_ids Идентификаторы счётчиков
+ * @param counter_count Количество счётчиков
+ * @param counters Значения счётчиков
+ * @return sai_status_t Статус SAI
+ */
+sai_status_t sai_get_port_stats(sai_port_id_t port_id, const sai_port_stat_counter_id_t *counter_ids,
+                                uint32_t counter_count, uint64_t *counters) {
+    if (!g_sai_port_ctx.initialized) {
+        LOG_ERROR("SAI Port module not initialized");
+        return SAI_STATUS_UNINITIALIZED;
+    }
+
+    if (port_id >= g_sai_port_ctx.port_count || (counter_count > 0 && (!counter_ids || !counters))) {
+        LOG_ERROR("Invalid port ID or counter list");
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+
+    port_stats_t stats;
+    if (port_get_stats((port_id_t)port_id, &stats) != STATUS_SUCCESS) {
+        LOG_ERROR("Failed to get port %u statistics from hardware", port_id);
+        return SAI_STATUS_PORT_STATS_FAILURE;
+    }
+
+    for (uint32_t i = 0; i < counter_count; i++) {
+        switch (counter_ids[i]) {
+            case SAI_PORT_STAT_IF_IN_OCTETS:          counters[i] = stats.rx_bytes; break;
+            case SAI_PORT_STAT_IF_IN_UCAST_PKTS:      counters[i] = stats.rx_unicast; break;
+            case SAI_PORT_STAT_IF_IN_NON_UCAST_PKTS:  counters[i] = stats.rx_multicast + stats.rx_broadcast; break;
+            case SAI_PORT_STAT_IF_IN_DISCARDS:        counters[i] = stats.rx_drops; break;
+            case SAI_PORT_STAT_IF_IN_ERRORS:          counters[i] = stats.rx_errors; break;
+            case SAI_PORT_STAT_IF_OUT_OCTETS:         counters[i] = stats.tx_bytes; break;
+            case SAI_PORT_STAT_IF_OUT_UCAST_PKTS:     counters[i] = stats.tx_unicast; break;
+            case SAI_PORT_STAT_IF_OUT_NON_UCAST_PKTS: counters[i] = stats.tx_multicast + stats.tx_broadcast; break;
+            case SAI_PORT_STAT_IF_OUT_DISCARDS:       counters[i] = stats.tx_drops; break;
+            case SAI_PORT_STAT_IF_OUT_ERRORS:         counters[i] = stats.tx_errors; break;
+            default:
+                return SAI_STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    return SAI_STATUS_SUCCESS;
+}
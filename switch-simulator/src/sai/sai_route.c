@@ -19,13 +19,84 @@ typedef struct {
     uint32_t route_count;
     sai_route_entry_t *route_entries;
     uint32_t max_routes;
+    uint32_t *free_indexes;     // Стек свободных индексов route_entries
+    uint32_t free_count;        // Число индексов в стеке
+    uint32_t *hash_slots;       // Индекс по (vrf, префикс, длина): номер записи + 1, 0 - пусто
+    uint32_t hash_mask;         // Число ячеек минус один
 } sai_route_context_t;
 
 // Глобальный контекст маршрутизации SAI
 static sai_route_context_t g_sai_route_ctx = {0};
 
 // Максимальное количество маршрутов
-#define MAX_ROUTE_COUNT 1024
+#define MAX_ROUTE_COUNT SAI_MAX_ROUTES
+
+/**
+ * @brief Хеш ключа маршрута (FNV-1a по VRF, длине и байтам префикса)
+ *
+ * Байты префикса хешируются целиком, так же как они сравниваются.
+ */
+static uint32_t sai_route_hash(const ip_addr_t *prefix, uint8_t prefix_len, uint32_t vrf_id) {
+    const uint8_t *bytes = (const uint8_t *)prefix;
+    uint32_t hash = 2166136261U;
+
+    for (size_t i = 0; i < sizeof(ip_addr_t); i++) {
+        hash = (hash ^ bytes[i]) * 16777619U;
+    }
+    hash = (hash ^ prefix_len) * 16777619U;
+    hash = (hash ^ vrf_id) * 16777619U;
+    return hash ^ (hash >> 15);
+}
+
+/**
+ * @brief Начальная ячейка записи в хеш-индексе
+ */
+static inline uint32_t sai_route_home_slot(uint32_t index) {
+    const sai_route_entry_t *entry = &g_sai_route_ctx.route_entries[index];
+
+    return sai_route_hash(&entry->prefix, entry->prefix_len, entry->vrf_id) & g_sai_route_ctx.hash_mask;
+}
+
+/**
+ * @brief Добавляет запись в хеш-индекс
+ * 
+ * @param index Индекс записи маршрута
+ */
+static void sai_route_hash_insert(uint32_t index) {
+    uint32_t slot = sai_route_home_slot(index);
+
+    while (g_sai_route_ctx.hash_slots[slot] != 0) {
+        slot = (slot + 1) & g_sai_route_ctx.hash_mask;
+    }
+    g_sai_route_ctx.hash_slots[slot] = index + 1;
+}
+
+/**
+ * @brief Удаляет запись из хеш-индекса
+ * 
+ * Записи цепочки пробирования за удалённой сдвигаются назад, поэтому
+ * индекс обходится без надгробий.
+ * 
+ * @param index Индекс записи маршрута, ключ которой ещё не стёрт
+ */
+static void sai_route_hash_remove(uint32_t index) {
+    uint32_t mask = g_sai_route_ctx.hash_mask;
+    uint32_t hole = sai_route_home_slot(index);
+
+    while (g_sai_route_ctx.hash_slots[hole] != index + 1) {
+        hole = (hole + 1) & mask;
+    }
+
+    for (uint32_t i = (hole + 1) & mask; g_sai_route_ctx.hash_slots[i] != 0; i = (i + 1) & mask) {
+        uint32_t home = sai_route_home_slot(g_sai_route_ctx.hash_slots[i] - 1);
+
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            g_sai_route_ctx.hash_slots[hole] = g_sai_route_ctx.hash_slots[i];
+            hole = i;
+        }
+    }
+    g_sai_route_ctx.hash_slots[hole] = 0;
+}
 
 /**
  * @brief Инициализирует модуль маршрутизации SAI
@@ -40,13 +111,32 @@ error_code_t sai_route_module_init(void) {
 
     LOG_INFO("Initializing SAI Route module");
     
-    // Выделение памяти под записи маршрутов
+    // Хеш-индекс заполнен не более чем наполовину
+    uint32_t hash_size = 1;
+    while (hash_size < 2 * MAX_ROUTE_COUNT) {
+        hash_size <<= 1;
+    }
+    
+    // Выделение памяти под записи маршрутов и индексы
     g_sai_route_ctx.route_entries = calloc(MAX_ROUTE_COUNT, sizeof(sai_route_entry_t));
-    if (!g_sai_route_ctx.route_entries) {
+    g_sai_route_ctx.free_indexes = malloc(MAX_ROUTE_COUNT * sizeof(uint32_t));
+    g_sai_route_ctx.hash_slots = calloc(hash_size, sizeof(uint32_t));
+    if (!g_sai_route_ctx.route_entries || !g_sai_route_ctx.free_indexes || !g_sai_route_ctx.hash_slots) {
         LOG_ERROR("Failed to allocate memory for route entries");
+        free(g_sai_route_ctx.route_entries);
+        free(g_sai_route_ctx.free_indexes);
+        free(g_sai_route_ctx.hash_slots);
+        memset(&g_sai_route_ctx, 0, sizeof(g_sai_route_ctx));
         return ERROR_MEMORY_ALLOCATION_FAILED;
     }
     
+    // Младшие индексы выдаются первыми
+    for (uint32_t i = 0; i < MAX_ROUTE_COUNT; i++) {
+        g_sai_route_ctx.free_indexes[i] = MAX_ROUTE_COUNT - 1 - i;
+    }
+    g_sai_route_ctx.free_count = MAX_ROUTE_COUNT;
+    g_sai_route_ctx.hash_mask = hash_size - 1;
+    
     g_sai_route_ctx.route_count = 0;
     g_sai_route_ctx.max_routes = MAX_ROUTE_COUNT;
     g_sai_route_ctx.initialized = true;
@@ -70,6 +160,8 @@ error_code_t sai_route_module_deinit(void) {
     
     // Освобождение ресурсов
     free(g_sai_route_ctx.route_entries);
+    free(g_sai_route_ctx.free_indexes);
+    free(g_sai_route_ctx.hash_slots);
     memset(&g_sai_route_ctx, 0, sizeof(g_sai_route_ctx));
     
     LOG_INFO("SAI Route module deinitialized successfully");
@@ -79,6 +171,8 @@ error_code_t sai_route_module_deinit(void) {
 /**
  * @brief Находит индекс свободной записи маршрута
  * 
+ * Индекс остаётся в стеке свободных, пока маршрут не создан.
+ * 
  * @param index Указатель для сохранения индекса
  * @return error_code_t Код ошибки
  */
@@ -87,21 +181,13 @@ static error_code_t find_free_route_index(uint32_t *index) {
         return ERROR_INVALID_PARAMETER;
     }
     
-    if (g_sai_route_ctx.route_count >= g_sai_route_ctx.max_routes) {
+    if (g_sai_route_ctx.free_count == 0) {
         LOG_ERROR("Route table is full");
         return ERROR_RESOURCE_EXHAUSTED;
     }
     
-    // Поиск свободной записи
-    for (uint32_t i = 0; i < g_sai_route_ctx.max_routes; i++) {
-        if (!g_sai_route_ctx.route_entries[i].is_valid) {
-            *index = i;
-            return ERROR_SUCCESS;
-        }
-    }
-    
-    LOG_ERROR("Failed to find free route entry despite count check");
-    return ERROR_INTERNAL;
+    *index = g_sai_route_ctx.free_indexes[g_sai_route_ctx.free_count - 1];
+    return ERROR_SUCCESS;
 }
 
 /**
@@ -118,10 +204,12 @@ static error_code_t find_route_index(ip_addr_t prefix, uint8_t prefix_len, uint3
         return ERROR_INVALID_PARAMETER;
     }
     
-    // Поиск записи с указанным префиксом
-    for (uint32_t i = 0; i < g_sai_route_ctx.max_routes; i++) {
-        if (g_sai_route_ctx.route_entries[i].is_valid &&
-            g_sai_route_ctx.route_entries[i].vrf_id == vrf_id &&
+    // Поиск записи с указанным префиксом по хеш-индексу
+    uint32_t slot = sai_route_hash(&prefix, prefix_len, vrf_id) & g_sai_route_ctx.hash_mask;
+    for (; g_sai_route_ctx.hash_slots[slot] != 0; slot = (slot + 1) & g_sai_route_ctx.hash_mask) {
+        uint32_t i = g_sai_route_ctx.hash_slots[slot] - 1;
+        
+        if (g_sai_route_ctx.route_entries[i].vrf_id == vrf_id &&
             g_sai_route_ctx.route_entries[i].prefix_len == prefix_len &&
             memcmp(&g_sai_route_ctx.route_entries[i].prefix, &prefix, sizeof(ip_addr_t)) == 0) {
             *index = i;
@@ -218,6 +306,9 @@ error_code_t sai_route_create(const sai_route_entry_t *route_entry) {
         return result;
     }
     
+    // Индекс занят: снимаем его со стека и вносим запись в хеш-индекс
+    g_sai_route_ctx.free_count--;
+    sai_route_hash_insert(index);
     g_sai_route_ctx.route_count++;
     
     LOG_INFO("Route created successfully, total routes: %u", g_sai_route_ctx.route_count);
@@ -270,8 +361,10 @@ error_code_t sai_route_remove(ip_addr_t prefix, uint8_t prefix_len, uint32_t vrf
         return result;
     }
     
-    // Очистка записи маршрута
+    // Очистка записи маршрута и возврат индекса в стек свободных
+    sai_route_hash_remove(index);
     memset(&g_sai_route_ctx.route_entries[index], 0, sizeof(sai_route_entry_t));
+    g_sai_route_ctx.free_indexes[g_sai_route_ctx.free_count++] = index;
     g_sai_route_ctx.route_count--;
     
     LOG_INFO("Route removed successfully, total routes: %u", g_sai_route_ctx.route_count);
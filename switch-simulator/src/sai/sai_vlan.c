@@ -4,6 +4,7 @@
  */
 
 #include "include/sai/sai_vlan.h"
+#include "include/sai/sai_bulk.h"
 #include "include/l2/vlan.h"
 #include "include/hal/port.h"
 #include "include/common/error_codes.h"
@@ -396,7 +397,440 @@ sai_status_t sai_vlan_get_info(uint16_t vlan_id, sai_vlan_info_t *vlan_info) {
     vlan_info->tagged_ports = vlan_table[vlan_id].tagged_ports;
     vlan_info->untagged_ports = vlan_table[vlan_id].untagged_ports;
     
-    LOG_INFO("Retrieved information for VLAN %d", vlan_id);
+    LOG_DEBUG("Retrieved information for VLAN %d", vlan_id);
+    
+    return SAI_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Преобразование кода возврата уровня L2 в статус SAI
+ * 
+ * @param status Код возврата L2
+ * @return sai_status_t Статус SAI
+ */
+static sai_status_t sai_vlan_status_from_l2(status_t status) {
+    switch (status) {
+        case STATUS_SUCCESS:
+            return SAI_STATUS_SUCCESS;
+        case ERROR_INVALID_PARAMETER:
+            return SAI_STATUS_INVALID_PARAMETER;
+        case STATUS_ALREADY_EXISTS:
+            return SAI_STATUS_ITEM_ALREADY_EXISTS;
+        case STATUS_NOT_FOUND:
+            return SAI_STATUS_ITEM_NOT_FOUND;
+        default:
+            return SAI_STATUS_FAILURE;
+    }
+}
+
+/**
+ * @brief Создание диапазона VLAN одной операцией
+ * 
+ * @param first_vlan Первый идентификатор VLAN диапазона
+ * @param last_vlan Последний идентификатор VLAN диапазона (включительно)
+ * @return sai_status_t Статус операции
+ */
+sai_status_t sai_vlan_create_range(sai_vlan_id_t first_vlan, sai_vlan_id_t last_vlan) {
+    if (!vlan_module_initialized) {
+        LOG_ERROR("SAI VLAN module not initialized");
+        return SAI_STATUS_UNINITIALIZED;
+    }
+    
+    if (first_vlan == 0 || last_vlan >= MAX_VLAN_COUNT || first_vlan > last_vlan) {
+        LOG_ERROR("Invalid VLAN range: %d-%d", first_vlan, last_vlan);
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+    
+    /* Весь диапазон создаётся на уровне L2 за одну критическую секцию */
+    status_t status = vlan_create_range(first_vlan, last_vlan);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR("Failed to create VLANs %d-%d at L2 level, status: %d", first_vlan, last_vlan, status);
+        return sai_vlan_status_from_l2(status);
+    }
+    
+    /* Инициализация локальных записей */
+    for (uint32_t vid = first_vlan; vid <= last_vlan; vid++) {
+        vlan_table[vid].is_active = true;
+        vlan_table[vid].tagged_ports = 0;
+        vlan_table[vid].untagged_ports = 0;
+        snprintf(vlan_table[vid].name, sizeof(vlan_table[vid].name), "VLAN%d", vid);
+    }
+    
+    LOG_INFO("Created VLANs %d-%d", first_vlan, last_vlan);
+    
+    return SAI_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Добавление набора портов во все VLAN диапазона одной операцией
+ * 
+ * @param first_vlan Первый идентификатор VLAN диапазона
+ * @param last_vlan Последний идентификатор VLAN диапазона (включительно)
+ * @param port_bitmap Битовая карта портов
+ * @param port_words Количество 64-битных слов в port_bitmap
+ * @param tagging_mode Режим тегирования новых членов VLAN
+ * @return sai_status_t Статус операции
+ */
+sai_status_t sai_vlan_add_ports_bitmap(sai_vlan_id_t first_vlan, sai_vlan_id_t last_vlan,
+                                       const uint64_t *port_bitmap, uint32_t port_words,
+                                       sai_vlan_tagging_mode_t tagging_mode) {
+    if (!vlan_module_initialized) {
+        LOG_ERROR("SAI VLAN module not initialized");
+        return SAI_STATUS_UNINITIALIZED;
+    }
+    
+    if (first_vlan == 0 || last_vlan >= MAX_VLAN_COUNT || first_vlan > last_vlan) {
+        LOG_ERROR("Invalid VLAN range: %d-%d", first_vlan, last_vlan);
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+    
+    if (port_bitmap == NULL) {
+        LOG_ERROR("Invalid port_bitmap pointer");
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+    
+    /* Приоритетное тегирование на уровне L2 не поддерживается */
+    if (tagging_mode == SAI_VLAN_TAGGING_MODE_PRIORITY) {
+        LOG_ERROR("Priority tagging is not supported for bulk VLAN membership");
+        return SAI_STATUS_NOT_SUPPORTED;
+    }
+    
+    /* Слова сверх размера битовой карты L2 должны быть пустыми */
+    vlan_port_bitmap_t ports;
+    memset(&ports, 0, sizeof(ports));
+    for (uint32_t w = 0; w < port_words; w++) {
+        if (w < VLAN_PORT_WORDS) {
+            ports.w[w] = port_bitmap[w];
+        } else if (port_bitmap[w] != 0) {
+            LOG_ERROR("Port bitmap exceeds %d ports", VLAN_PORT_WORDS * 64);
+            return SAI_STATUS_INVALID_PARAMETER;
+        }
+    }
+    
+    bool tagged = (tagging_mode == SAI_VLAN_TAGGING_MODE_TAGGED);
+    status_t status = vlan_add_ports_bitmap(first_vlan, last_vlan, &ports,
+                                            tagged ? VLAN_MEMBER_TAGGED : VLAN_MEMBER_UNTAGGED);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR("Failed to add ports to VLANs %d-%d at L2 level, status: %d", first_vlan, last_vlan, status);
+        return sai_vlan_status_from_l2(status);
+    }
+    
+    /* Обновление локальных записей (локальная таблица хранит только первые 16 портов) */
+    uint16_t port_mask = (uint16_t)ports.w[0];
+    for (uint32_t vid = first_vlan; vid <= last_vlan; vid++) {
+        if (tagged) {
+            vlan_table[vid].tagged_ports |= port_mask;
+            vlan_table[vid].untagged_ports &= ~port_mask;
+        } else {
+            vlan_table[vid].untagged_ports |= port_mask;
+            vlan_table[vid].tagged_ports &= ~port_mask;
+        }
+    }
+    
+    LOG_INFO("Added ports to VLANs %d-%d as %s members", first_vlan, last_vlan, tagged ? "tagged" : "untagged");
+    
+    return SAI_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Обновление локальной записи VLAN после изменения членства порта
+ * 
+ * @param vlan_id Идентификатор VLAN
+ * @param port_id Идентификатор порта
+ * @param add Порт добавлен (иначе удалён)
+ * @param tagged Порт добавлен как тегированный
+ */
+static void sai_vlan_update_local_member(sai_vlan_id_t vlan_id, sai_port_id_t port_id, bool add, bool tagged) {
+    /* Локальная таблица хранит только первые 16 портов */
+    if (port_id >= 16) {
+        return;
+    }
+    
+    uint16_t port_mask = (uint16_t)(1 << port_id);
+    vlan_table[vlan_id].tagged_ports &= ~port_mask;
+    vlan_table[vlan_id].untagged_ports &= ~port_mask;
+    if (add) {
+        if (tagged) {
+            vlan_table[vlan_id].tagged_ports |= port_mask;
+        } else {
+            vlan_table[vlan_id].untagged_ports |= port_mask;
+        }
+    }
+}
+
+/**
+ * @brief Общая часть пакетного создания и удаления членов VLAN
+ * 
+ * Члены, прошедшие проверку, передаются в L2 одним вызовом: блокировка
+ * VLAN берётся один раз, а каждый затронутый VLAN и порт перестраивается
+ * один раз на весь пакет.
+ * 
+ * @param object_count Количество членов
+ * @param members Члены VLAN
+ * @param add Создавать членов (иначе удалять)
+ * @param mode Режим обработки ошибок
+ * @param object_statuses Статусы членов
+ * @return sai_status_t Статус операции
+ */
+static sai_status_t sai_vlan_bulk_members(uint32_t object_count, const sai_bulk_vlan_member_t *members,
+                                          bool add, sai_bulk_op_error_mode_t mode,
+                                          sai_status_t *object_statuses) {
+    bool stop_on_error = (mode == SAI_BULK_OP_ERROR_MODE_STOP_ON_ERROR);
+    uint32_t n = 0;
+    
+    if (!vlan_module_initialized) {
+        LOG_ERROR("SAI VLAN module not initialized");
+        return SAI_STATUS_UNINITIALIZED;
+    }
+    
+    if (object_count == 0) {
+        return SAI_STATUS_SUCCESS;
+    }
+    
+    vlan_member_t *l2_members = calloc(object_count, sizeof(vlan_member_t));
+    status_t *l2_statuses = calloc(object_count, sizeof(status_t));
+    uint32_t *index = calloc(object_count, sizeof(uint32_t));
+    if (l2_members == NULL || l2_statuses == NULL || index == NULL) {
+        LOG_ERROR("Failed to allocate memory for %u VLAN members", object_count);
+        free(l2_members);
+        free(l2_statuses);
+        free(index);
+        return SAI_STATUS_INSUFFICIENT_RESOURCES;
+    }
+    
+    /* Проверки уровня SAI; в режиме остановки L2 получает только членов до первой ошибки */
+    for (uint32_t i = 0; i < object_count; i++) {
+        const sai_bulk_vlan_member_t *member = &members[i];
+        sai_status_t status = SAI_STATUS_SUCCESS;
+        
+        if (member->vlan_id == 0 || member->vlan_id >= MAX_VLAN_COUNT) {
+            status = SAI_STATUS_INVALID_VLAN_ID;
+        } else if (!vlan_table[member->vlan_id].is_active) {
+            status = SAI_STATUS_ITEM_NOT_FOUND;
+        } else if (add && member->tagging_mode == SAI_VLAN_TAGGING_MODE_PRIORITY) {
+            status = SAI_STATUS_NOT_SUPPORTED;
+        }
+        
+        object_statuses[i] = status;
+        if (status != SAI_STATUS_SUCCESS) {
+            if (stop_on_error) {
+                break;
+            }
+            continue;
+        }
+        
+        l2_members[n].vlan_id = member->vlan_id;
+        l2_members[n].port_id = (port_id_t)member->port_id;
+        l2_members[n].member_type = (member->tagging_mode == SAI_VLAN_TAGGING_MODE_TAGGED) ?
+                                    VLAN_MEMBER_TAGGED : VLAN_MEMBER_UNTAGGED;
+        index[n++] = i;
+    }
+    
+    status_t status = add ? vlan_add_members_bulk(l2_members, n, stop_on_error, l2_statuses)
+                          : vlan_remove_members_bulk(l2_members, n, stop_on_error, l2_statuses);
+    
+    for (uint32_t k = 0; k < n; k++) {
+        if (status == ERROR_NOT_INITIALIZED) {
+            l2_statuses[k] = ERROR_NOT_INITIALIZED;
+        }
+        object_statuses[index[k]] = (l2_statuses[k] == STATUS_NOT_EXECUTED) ?
+                                    SAI_STATUS_NOT_EXECUTED : sai_vlan_status_from_l2(l2_statuses[k]);
+        if (l2_statuses[k] == STATUS_SUCCESS) {
+            sai_vlan_update_local_member(l2_members[k].vlan_id, l2_members[k].port_id, add,
+                                         l2_members[k].member_type == VLAN_MEMBER_TAGGED);
+        }
+    }
+    
+    /* В режиме остановки члены после первой ошибки не обрабатывались */
+    if (stop_on_error) {
+        bool failed = false;
+        for (uint32_t i = 0; i < object_count; i++) {
+            if (failed) {
+                object_statuses[i] = SAI_STATUS_NOT_EXECUTED;
+            } else if (object_statuses[i] != SAI_STATUS_SUCCESS) {
+                failed = true;
+            }
+        }
+    }
+    
+    free(l2_members);
+    free(l2_statuses);
+    free(index);
+    
+    for (uint32_t i = 0; i < object_count; i++) {
+        if (object_statuses[i] != SAI_STATUS_SUCCESS) {
+            return SAI_STATUS_FAILURE;
+        }
+    }
+    
+    LOG_INFO("Bulk %s of %u VLAN members", add ? "creation" : "removal", object_count);
+    
+    return SAI_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Пакетное создание членов VLAN
+ * 
+ * @param object_count Количество членов
+ * @param members Члены VLAN
+ * @param mode Режим обработки ошибок
+ * @param member_ids Идентификаторы созданных членов (может быть NULL)
+ * @param object_statuses Статусы членов
+ * @return sai_status_t Статус операции
+ */
+sai_status_t sai_bulk_create_vlan_member(uint32_t object_count, const sai_bulk_vlan_member_t *members,
+                                         sai_bulk_op_error_mode_t mode, sai_vlan_member_id_t *member_ids,
+                                         sai_status_t *object_statuses) {
+    if ((object_count > 0 && members == NULL) || object_statuses == NULL) {
+        LOG_ERROR("Invalid parameters for bulk VLAN member creation");
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+    
+    sai_status_t status = sai_vlan_bulk_members(object_count, members, true, mode, object_statuses);
+    
+    if (member_ids != NULL) {
+        for (uint32_t i = 0; i < object_count; i++) {
+            member_ids[i] = (object_statuses[i] == SAI_STATUS_SUCCESS) ?
+                            SAI_VLAN_MEMBER_ID(members[i].vlan_id, members[i].port_id) : 0;
+        }
+    }
+    
+    return status;
+}
+
+/**
+ * @brief Пакетное удаление членов VLAN
+ * 
+ * @param object_count Количество членов
+ * @param member_ids Идентификаторы членов
+ * @param mode Режим обработки ошибок
+ * @param object_statuses Статусы членов
+ * @return sai_status_t Статус операции
+ */
+sai_status_t sai_bulk_remove_vlan_member(uint32_t object_count, const sai_vlan_member_id_t *member_ids,
+                                         sai_bulk_op_error_mode_t mode, sai_status_t *object_statuses) {
+    if ((object_count > 0 && member_ids == NULL) || object_statuses == NULL) {
+        LOG_ERROR("Invalid parameters for bulk VLAN member removal");
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+    
+    if (object_count == 0) {
+        return SAI_STATUS_SUCCESS;
+    }
+    
+    sai_bulk_vlan_member_t *members = calloc(object_count, sizeof(sai_bulk_vlan_member_t));
+    if (members == NULL) {
+        LOG_ERROR("Failed to allocate memory for %u VLAN members", object_count);
+        return SAI_STATUS_INSUFFICIENT_RESOURCES;
+    }
+    
+    for (uint32_t i = 0; i < object_count; i++) {
+        members[i].vlan_id = SAI_VLAN_MEMBER_ID_VLAN(member_ids[i]);
+        members[i].port_id = SAI_VLAN_MEMBER_ID_PORT(member_ids[i]);
+    }
+    
+    sai_status_t status = sai_vlan_bulk_members(object_count, members, false, mode, object_statuses);
+    free(members);
+    
+    return status;
+}
+
+/**
+ * @brief Замена набора разрешённых VLAN на транковом порту
+ * 
+ * @param port_id Идентификатор порта
+ * @param vlan_bitmap Битовая карта VLAN из 64 слов
+ * @return sai_status_t Статус операции
+ */
+sai_status_t sai_vlan_set_trunk_allowed_bitmap(sai_port_id_t port_id, const uint64_t *vlan_bitmap) {
+    if (!vlan_module_initialized) {
+        LOG_ERROR("SAI VLAN module not initialized");
+        return SAI_STATUS_UNINITIALIZED;
+    }
+    
+    if (vlan_bitmap == NULL) {
+        LOG_ERROR("Invalid vlan_bitmap pointer");
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+    
+    if (!port_is_valid(port_id)) {
+        LOG_ERROR("Invalid port ID: %d", port_id);
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+    
+    status_t status = vlan_set_trunk_allowed_bitmap(port_id, vlan_bitmap);
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR("Failed to set allowed VLANs on port %d at L2 level, status: %d", port_id, status);
+        return sai_vlan_status_from_l2(status);
+    }
+    
+    LOG_INFO("Updated allowed VLANs on trunk port %d", port_id);
+    
+    return SAI_STATUS_SUCCESS;
+}
+
+/**
+ * @brief Установка атрибута члена VLAN
+ * 
+ * Поддерживаются атрибуты трансляции VID: они заполняют таблицы порта
+ * с прямой индексацией, поэтому трансляция не требует повторного прохода
+ * пакета по конвейеру.
+ * 
+ * @param vlan_member_id Идентификатор члена VLAN (SAI_VLAN_MEMBER_ID)
+ * @param attr Устанавливаемый атрибут
+ * @return sai_status_t Статус операции
+ */
+sai_status_t sai_set_vlan_member_attribute(sai_vlan_member_id_t vlan_member_id,
+                                           const sai_vlan_member_attr_t *attr) {
+    sai_vlan_id_t vlan_id = SAI_VLAN_MEMBER_ID_VLAN(vlan_member_id);
+    sai_port_id_t port_id = SAI_VLAN_MEMBER_ID_PORT(vlan_member_id);
+    status_t status;
+    
+    if (!vlan_module_initialized) {
+        LOG_ERROR("SAI VLAN module not initialized");
+        return SAI_STATUS_UNINITIALIZED;
+    }
+    
+    if (attr == NULL) {
+        LOG_ERROR("Invalid attr pointer");
+        return SAI_STATUS_INVALID_PARAMETER;
+    }
+    
+    if (vlan_id == 0 || vlan_id >= MAX_VLAN_COUNT || !port_is_valid(port_id)) {
+        LOG_ERROR("Invalid VLAN member ID: 0x%08x", vlan_member_id);
+        return SAI_STATUS_INVALID_OBJECT_ID;
+    }
+    
+    switch (attr->id) {
+        case SAI_VLAN_MEMBER_ATTR_INGRESS_VID:
+            /* Кадры с этим VID на порту классифицируются в VLAN члена */
+            if (attr->value.translated_vid == 0) {
+                LOG_ERROR("Invalid ingress VID 0 for VLAN %d on port %d", vlan_id, port_id);
+                return SAI_STATUS_ATTR_OUT_OF_RANGE;
+            }
+            status = vlan_set_ingress_translation(port_id, attr->value.translated_vid, vlan_id);
+            break;
+        case SAI_VLAN_MEMBER_ATTR_EGRESS_VID:
+            /* 0 отменяет трансляцию */
+            status = vlan_set_egress_translation(port_id, vlan_id, attr->value.translated_vid);
+            break;
+        case SAI_VLAN_MEMBER_ATTR_VLAN_ID:
+        case SAI_VLAN_MEMBER_ATTR_PORT_ID:
+            return SAI_STATUS_ATTR_READ_ONLY;
+        default:
+            LOG_ERROR("Unsupported VLAN member attribute: %d", attr->id);
+            return SAI_STATUS_ATTR_NOT_IMPLEMENTED;
+    }
+    
+    if (status != STATUS_SUCCESS) {
+        LOG_ERROR("Failed to set VID translation for VLAN %d on port %d at L2 level, status: %d",
+                  vlan_id, port_id, status);
+        return sai_vlan_status_from_l2(status);
+    }
+    
+    LOG_INFO("Set %s VID %d for VLAN %d on port %d",
+             attr->id == SAI_VLAN_MEMBER_ATTR_INGRESS_VID ? "ingress" : "egress",
+             attr->value.translated_vid, vlan_id, port_id);
     
     return SAI_STATUS_SUCCESS;
 }
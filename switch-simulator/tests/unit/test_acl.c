@@ -0,0 +1,333 @@
+/**
+ * @file test_acl.c
+ * @brief Unit tests for the ACL classifier and policy-based routing
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <arpa/inet.h>
+#include "../../include/l3/acl.h"
+#include "../../include/l3/ip.h"
+#include "../../include/hal/packet.h"
+#include "../../include/hal/port.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define ETH_HDR_LEN 14
+#define UDP_HDR_LEN 8
+
+static packet_buffer_t *make_udp4(uint32_t src, uint32_t dst, uint16_t sport, uint16_t dport, port_id_t in_port) {
+    uint8_t frame[ETH_HDR_LEN + sizeof(ipv4_header_t) + UDP_HDR_LEN + 18] = {0};
+    ipv4_header_t ip = {0};
+    uint8_t *udp = frame + ETH_HDR_LEN + sizeof(ipv4_header_t);
+    packet_buffer_t *pkt = packet_buffer_alloc(128);
+
+    // The header is built aligned and copied in, as it sits at an odd offset in the frame
+    memset(frame, 0xAA, 6);
+    memset(frame + 6, 0xBB, 6);
+    frame[12] = 0x08; frame[13] = 0x00;
+    ip.version_ihl = 0x45;
+    ip.total_length = htons(sizeof(frame) - ETH_HDR_LEN);
+    ip.ttl = 64;
+    ip.protocol = IP_PROTO_UDP;
+    ip.src_addr = htonl(src);
+    ip.dst_addr = htonl(dst);
+    memcpy(frame + ETH_HDR_LEN, &ip, sizeof(ip));
+    udp[0] = (uint8_t)(sport >> 8); udp[1] = (uint8_t)sport;
+    udp[2] = (uint8_t)(dport >> 8); udp[3] = (uint8_t)dport;
+    udp[5] = UDP_HDR_LEN + 18;
+
+    assert(pkt != NULL);
+    assert(packet_append_data(pkt, frame, sizeof(frame)) == STATUS_SUCCESS);
+    assert(packet_parse(pkt) == STATUS_SUCCESS);
+    pkt->metadata.port = in_port;
+    return pkt;
+}
+
+static packet_buffer_t *make_udp6(uint8_t src_last, uint16_t dport) {
+    uint8_t frame[ETH_HDR_LEN + sizeof(ipv6_header_t) + UDP_HDR_LEN + 8] = {0};
+    ipv6_header_t ip;
+    uint8_t *udp = frame + ETH_HDR_LEN + sizeof(ipv6_header_t);
+    packet_buffer_t *pkt = packet_buffer_alloc(128);
+
+    memset(&ip, 0, sizeof(ip));
+    memset(frame, 0xAA, 6);
+    memset(frame + 6, 0xBB, 6);
+    frame[12] = 0x86; frame[13] = 0xDD;
+    ip.version_class_flow = htonl(0x60000000);
+    ip.payload_length = htons(UDP_HDR_LEN + 8);
+    ip.next_header = IP_PROTO_UDP;
+    ip.hop_limit = 64;
+    ip.src_addr.addr[0] = 0x20; ip.src_addr.addr[1] = 0x01; ip.src_addr.addr[15] = src_last;
+    ip.dst_addr.addr[0] = 0x20; ip.dst_addr.addr[1] = 0x01; ip.dst_addr.addr[15] = 0xFF;
+    memcpy(frame + ETH_HDR_LEN, &ip, sizeof(ip));
+    udp[2] = (uint8_t)(dport >> 8); udp[3] = (uint8_t)dport;
+    udp[5] = UDP_HDR_LEN + 8;
+
+    assert(pkt != NULL);
+    assert(packet_append_data(pkt, frame, sizeof(frame)) == STATUS_SUCCESS);
+    assert(packet_parse(pkt) == STATUS_SUCCESS);
+    return pkt;
+}
+
+static acl_rule_t any_rule(uint32_t rule_id, acl_action_t action) {
+    acl_rule_t rule;
+
+    memset(&rule, 0, sizeof(rule));
+    rule.rule_id = rule_id;
+    rule.src_addr.type = IP_TYPE_V4;
+    rule.dst_addr.type = IP_TYPE_V4;
+    rule.src_port_max = 0xFFFF;
+    rule.dst_port_max = 0xFFFF;
+    rule.in_port = PORT_ID_INVALID;
+    rule.action = action;
+    return rule;
+}
+
+static acl_action_t classify(packet_buffer_t *pkt) {
+    acl_action_t action;
+
+    assert(acl_classify_burst(&pkt, 1, &action) == STATUS_SUCCESS);
+    return action;
+}
+
+static uint64_t rule_hits(uint32_t rule_id) {
+    uint64_t hits;
+
+    assert(acl_get_rule_hits(rule_id, &hits) == STATUS_SUCCESS);
+    return hits;
+}
+
+static void bring_up(port_id_t port) {
+    // The simulated link comes up at random once the port is enabled
+    while (!port_is_up(port)) {
+        assert(port_set_admin_state(port, false) == STATUS_SUCCESS);
+        assert(port_set_admin_state(port, true) == STATUS_SUCCESS);
+    }
+}
+
+void test_acl_first_match() {
+    acl_rule_t rules[2] = { any_rule(1, ACL_ACTION_DENY), any_rule(2, ACL_ACTION_PERMIT) };
+    packet_buffer_t *dns = make_udp4(0x0A010203, 0xC0A80001, 1000, 53, 1);
+    packet_buffer_t *web = make_udp4(0x0A010203, 0xC0A80001, 1000, 80, 1);
+    packet_buffer_t *other = make_udp4(0x0B000001, 0xC0A80001, 1000, 53, 1);
+    acl_stats_t stats;
+
+    assert(acl_init() == STATUS_SUCCESS);
+
+    // DNS from 10/8 is denied ahead of the broader permit of 10.1/16
+    rules[0].src_addr.addr.v4 = htonl(0x0A000000);
+    rules[0].src_prefix_len = 8;
+    rules[0].protocol = IP_PROTO_UDP;
+    rules[0].match_protocol = true;
+    rules[0].dst_port_min = rules[0].dst_port_max = 53;
+    rules[1].src_addr.addr.v4 = htonl(0x0A010000);
+    rules[1].src_prefix_len = 16;
+    assert(acl_set_rules(rules, 2, ACL_ACTION_DENY) == STATUS_SUCCESS);
+
+    assert(classify(dns) == ACL_ACTION_DENY);
+    assert(classify(web) == ACL_ACTION_PERMIT);
+    assert(classify(other) == ACL_ACTION_DENY);
+
+    assert(rule_hits(1) == 1 && rule_hits(2) == 1);
+    assert(acl_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.rule_count == 2);
+    assert(stats.default_hits == 1);
+    assert(stats.denied == 2 && stats.permitted == 1);
+
+    assert(acl_cleanup() == STATUS_SUCCESS);
+    packet_buffer_free(dns);
+    packet_buffer_free(web);
+    packet_buffer_free(other);
+    printf(TEST_PASSED, "test_acl_first_match");
+}
+
+void test_acl_ports_and_ingress() {
+    acl_rule_t rules[2] = { any_rule(1, ACL_ACTION_DENY), any_rule(2, ACL_ACTION_DENY) };
+    packet_buffer_t *low = make_udp4(0x0A000001, 0x0A000002, 1000, 1023, 1);
+    packet_buffer_t *high = make_udp4(0x0A000001, 0x0A000002, 1000, 1024, 1);
+    packet_buffer_t *other_port = make_udp4(0x0A000001, 0x0A000002, 1000, 8080, 2);
+    packet_buffer_t *batch[3] = { low, high, other_port };
+    acl_action_t actions[3];
+
+    assert(acl_init() == STATUS_SUCCESS);
+
+    // Well-known ports are denied anywhere, port 1 is closed altogether
+    rules[0].dst_port_max = 1023;
+    rules[1].in_port = 2;
+    assert(acl_set_rules(rules, 2, ACL_ACTION_PERMIT) == STATUS_SUCCESS);
+
+    assert(acl_classify_burst(batch, 3, actions) == STATUS_SUCCESS);
+    assert(actions[0] == ACL_ACTION_DENY);
+    assert(actions[1] == ACL_ACTION_PERMIT);
+    assert(actions[2] == ACL_ACTION_DENY);
+    assert(rule_hits(1) == 1 && rule_hits(2) == 1);
+
+    assert(acl_cleanup() == STATUS_SUCCESS);
+    packet_buffer_free(low);
+    packet_buffer_free(high);
+    packet_buffer_free(other_port);
+    printf(TEST_PASSED, "test_acl_ports_and_ingress");
+}
+
+void test_acl_replace_rules() {
+    acl_rule_t deny = any_rule(1, ACL_ACTION_DENY);
+    acl_rule_t bad[2] = { any_rule(2, ACL_ACTION_PERMIT), any_rule(2, ACL_ACTION_PERMIT) };
+    packet_buffer_t *pkt = make_udp4(0x0A000001, 0x0A000002, 1000, 2000, 1);
+    acl_stats_t stats;
+
+    assert(acl_init() == STATUS_SUCCESS);
+
+    // An empty rule set applies its default to everything
+    assert(classify(pkt) == ACL_ACTION_PERMIT);
+    assert(acl_set_rules(&deny, 1, ACL_ACTION_PERMIT) == STATUS_SUCCESS);
+    assert(classify(pkt) == ACL_ACTION_DENY);
+
+    // A rule set that does not validate leaves the active one in place
+    assert(acl_set_rules(bad, 2, ACL_ACTION_PERMIT) == STATUS_INVALID_PARAMETER);
+    bad[1].rule_id = 3;
+    bad[1].src_prefix_len = 33;
+    assert(acl_set_rules(bad, 2, ACL_ACTION_PERMIT) == STATUS_INVALID_PARAMETER);
+    bad[1].src_prefix_len = 0;
+    bad[1].action = ACL_ACTION_REDIRECT;
+    assert(acl_set_rules(bad, 2, ACL_ACTION_PERMIT) == STATUS_INVALID_PARAMETER);
+    assert(acl_set_rules(&deny, 1, ACL_ACTION_REDIRECT) == STATUS_INVALID_PARAMETER);
+    assert(classify(pkt) == ACL_ACTION_DENY);
+    assert(acl_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.rule_count == 1);
+
+    // Clearing the rules goes back to the default
+    assert(acl_set_rules(NULL, 0, ACL_ACTION_PERMIT) == STATUS_SUCCESS);
+    assert(classify(pkt) == ACL_ACTION_PERMIT);
+
+    assert(acl_cleanup() == STATUS_SUCCESS);
+    packet_buffer_free(pkt);
+    printf(TEST_PASSED, "test_acl_replace_rules");
+}
+
+void test_acl_ipv6_and_non_ip() {
+    acl_rule_t rule = any_rule(1, ACL_ACTION_DENY);
+    packet_buffer_t *blocked = make_udp6(0x01, 53);
+    packet_buffer_t *allowed = make_udp6(0x02, 53);
+    packet_buffer_t *v4 = make_udp4(0x0A000001, 0x0A000002, 1000, 53, 1);
+    packet_buffer_t *arp = packet_buffer_alloc(128);
+    uint8_t frame[60] = {0};
+    acl_stats_t stats;
+
+    assert(arp != NULL);
+    frame[12] = 0x08; frame[13] = 0x06;
+    assert(packet_append_data(arp, frame, sizeof(frame)) == STATUS_SUCCESS);
+
+    assert(acl_init() == STATUS_SUCCESS);
+
+    // One IPv6 host is denied; the rule's family keeps IPv4 out of it
+    rule.src_addr.type = IP_TYPE_V6;
+    rule.dst_addr.type = IP_TYPE_V6;
+    rule.src_addr.addr.v6.addr[0] = 0x20;
+    rule.src_addr.addr.v6.addr[1] = 0x01;
+    rule.src_addr.addr.v6.addr[15] = 0x01;
+    rule.src_prefix_len = 128;
+    assert(acl_set_rules(&rule, 1, ACL_ACTION_PERMIT) == STATUS_SUCCESS);
+
+    assert(classify(blocked) == ACL_ACTION_DENY);
+    assert(classify(allowed) == ACL_ACTION_PERMIT);
+    assert(classify(v4) == ACL_ACTION_PERMIT);
+
+    // Frames that are not IP pass without being counted
+    assert(classify(arp) == ACL_ACTION_PERMIT);
+    assert(acl_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.permitted + stats.denied == 3);
+
+    assert(acl_cleanup() == STATUS_SUCCESS);
+    packet_buffer_free(blocked);
+    packet_buffer_free(allowed);
+    packet_buffer_free(v4);
+    packet_buffer_free(arp);
+    printf(TEST_PASSED, "test_acl_ipv6_and_non_ip");
+}
+
+void test_acl_pbr() {
+    acl_pbr_path_t paths[2];
+    acl_rule_t rules[2] = { any_rule(1, ACL_ACTION_PERMIT), any_rule(2, ACL_ACTION_REDIRECT) };
+    packet_buffer_t *redirected = make_udp4(0x0A000001, 0xC0A80001, 1000, 2000, 1);
+    packet_buffer_t *exempt = make_udp4(0x0A000001, 0xC0A80001, 1000, 22, 1);
+    packet_buffer_t *unattached = make_udp4(0x0A000001, 0xC0A80001, 1000, 2000, 2);
+    ip_addr_t next_hop;
+    port_id_t egress;
+    acl_stats_t stats;
+
+    assert(acl_init() == STATUS_SUCCESS);
+    bring_up(5);
+    bring_up(6);
+
+    memset(paths, 0, sizeof(paths));
+    paths[0].next_hop.type = IP_TYPE_V4;
+    paths[0].next_hop.addr.v4 = htonl(0xAC100001);
+    paths[0].egress_port = 5;
+    paths[1].next_hop.type = IP_TYPE_V4;
+    paths[1].next_hop.addr.v4 = htonl(0xAC100002);
+    paths[1].egress_port = 6;
+    assert(acl_pbr_set_group(0, paths, 2) == STATUS_INVALID_PARAMETER);
+    assert(acl_pbr_set_group(7, paths, 2) == STATUS_SUCCESS);
+
+    // SSH follows the FIB, everything else from 10/8 goes to group 7
+    rules[0].dst_port_min = rules[0].dst_port_max = 22;
+    rules[1].src_addr.addr.v4 = htonl(0x0A000000);
+    rules[1].src_prefix_len = 8;
+    rules[1].nh_group = 7;
+    assert(acl_pbr_set_policy(3, rules, 2) == STATUS_SUCCESS);
+    assert(acl_pbr_attach(1, 3) == STATUS_SUCCESS);
+    assert(acl_pbr_attach(1, ACL_PBR_MAX_POLICIES) == STATUS_INVALID_PARAMETER);
+
+    assert(acl_pbr_lookup(redirected, ETH_HDR_LEN, &next_hop, &egress) == STATUS_SUCCESS);
+    assert(next_hop.type == IP_TYPE_V4);
+    assert((egress == 5 && next_hop.addr.v4 == paths[0].next_hop.addr.v4) ||
+           (egress == 6 && next_hop.addr.v4 == paths[1].next_hop.addr.v4));
+    assert(acl_pbr_lookup(exempt, ETH_HDR_LEN, &next_hop, &egress) == STATUS_NOT_FOUND);
+    assert(acl_pbr_lookup(unattached, ETH_HDR_LEN, &next_hop, &egress) == STATUS_NOT_FOUND);
+
+    // A path that goes down hands its flows to the other one
+    assert(port_set_admin_state(egress, false) == STATUS_SUCCESS);
+    port_id_t survivor = egress == 5 ? 6 : 5;
+    assert(acl_pbr_lookup(redirected, ETH_HDR_LEN, &next_hop, &egress) == STATUS_SUCCESS);
+    assert(egress == survivor);
+
+    // With no path up the FIB routes the packet
+    assert(port_set_admin_state(survivor, false) == STATUS_SUCCESS);
+    assert(acl_pbr_lookup(redirected, ETH_HDR_LEN, &next_hop, &egress) == STATUS_NOT_FOUND);
+    assert(acl_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.pbr_redirected == 2 && stats.pbr_fallbacks == 1);
+
+    // Detached ports are not redirected at all
+    bring_up(5);
+    assert(acl_pbr_attach(1, ACL_PBR_NONE) == STATUS_SUCCESS);
+    assert(acl_pbr_lookup(redirected, ETH_HDR_LEN, &next_hop, &egress) == STATUS_NOT_FOUND);
+
+    assert(acl_cleanup() == STATUS_SUCCESS);
+    packet_buffer_free(redirected);
+    packet_buffer_free(exempt);
+    packet_buffer_free(unattached);
+    printf(TEST_PASSED, "test_acl_pbr");
+}
+
+int main() {
+    printf("Running ACL unit tests...\n");
+
+    assert(port_init() == STATUS_SUCCESS);
+    assert(packet_init() == STATUS_SUCCESS);
+
+    test_acl_first_match();
+    test_acl_ports_and_ingress();
+    test_acl_replace_rules();
+    test_acl_ipv6_and_non_ip();
+    test_acl_pbr();
+
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All ACL tests completed successfully.\n");
+    return 0;
+}
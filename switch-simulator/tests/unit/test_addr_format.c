@@ -0,0 +1,153 @@
+/**
+ * @file test_addr_format.c
+ * @brief Unit tests for the MAC, IPv4 and IPv6 formatting and parsing helpers
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/common/utils.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+void test_mac_format() {
+    mac_addr_t mac = { .addr = { 0x00, 0x1a, 0x2B, 0xc3, 0xff, 0x09 } };
+    mac_addr_t parsed;
+    char buf[MAC_STRING_SIZE];
+
+    // Two lowercase digits per octet
+    assert(mac_to_string(&mac, buf) == buf);
+    assert(strcmp(buf, "00:1a:2b:c3:ff:09") == 0);
+    assert(mac_to_string(NULL, buf) == NULL);
+
+    assert(string_to_mac("00:1A:2b:C3:ff:09", &parsed) == STATUS_SUCCESS);
+    assert(memcmp(parsed.addr, mac.addr, MAC_ADDR_LEN) == 0);
+    assert(string_to_mac("0:1a:2b:c3:ff:9", &parsed) == STATUS_SUCCESS);
+    assert(memcmp(parsed.addr, mac.addr, MAC_ADDR_LEN) == 0);
+
+    // Wrong separators, digits, lengths and trailing text
+    assert(string_to_mac("00-1a-2b-c3-ff-09", &parsed) == STATUS_INVALID_PARAMETER);
+    assert(string_to_mac("00:1a:2b:c3:ff", &parsed) == STATUS_INVALID_PARAMETER);
+    assert(string_to_mac("00:1a:2b:c3:ff:09:", &parsed) == STATUS_INVALID_PARAMETER);
+    assert(string_to_mac("00:1a:2b:c3:ff:0g", &parsed) == STATUS_INVALID_PARAMETER);
+    assert(string_to_mac("000:1a:2b:c3:ff:09", &parsed) == STATUS_INVALID_PARAMETER);
+    assert(string_to_mac("::::::", &parsed) == STATUS_INVALID_PARAMETER);
+    assert(string_to_mac(NULL, &parsed) == STATUS_INVALID_PARAMETER);
+    assert(string_to_mac("00:1a:2b:c3:ff:09", NULL) == STATUS_INVALID_PARAMETER);
+
+    printf(TEST_PASSED, "test_mac_format");
+}
+
+void test_ipv4_format() {
+    ipv4_addr_t addr;
+    char buf[IPV4_STRING_SIZE];
+
+    // First octet in the most significant byte
+    assert(strcmp(ipv4_to_string(0xC0A80A01u, buf), "192.168.10.1") == 0);
+    assert(strcmp(ipv4_to_string(0, buf), "0.0.0.0") == 0);
+    assert(strcmp(ipv4_to_string(0xFFFFFFFFu, buf), "255.255.255.255") == 0);
+    assert(ipv4_to_string(1, NULL) == NULL);
+
+    assert(string_to_ipv4("192.168.10.1", &addr) == STATUS_SUCCESS && addr == 0xC0A80A01u);
+    assert(string_to_ipv4("255.255.255.255", &addr) == STATUS_SUCCESS && addr == 0xFFFFFFFFu);
+    assert(string_to_ipv4("010.0.0.1", &addr) == STATUS_SUCCESS && addr == 0x0A000001u);
+
+    assert(string_to_ipv4("256.0.0.1", &addr) == STATUS_INVALID_PARAMETER);
+    assert(string_to_ipv4("1.2.3", &addr) == STATUS_INVALID_PARAMETER);
+    assert(string_to_ipv4("1.2.3.4.5", &addr) == STATUS_INVALID_PARAMETER);
+    assert(string_to_ipv4("1..3.4", &addr) == STATUS_INVALID_PARAMETER);
+    assert(string_to_ipv4("1.2.3.4 ", &addr) == STATUS_INVALID_PARAMETER);
+    assert(string_to_ipv4("1.2.3.1000", &addr) == STATUS_INVALID_PARAMETER);
+    assert(string_to_ipv4(NULL, &addr) == STATUS_INVALID_PARAMETER);
+
+    printf(TEST_PASSED, "test_ipv4_format");
+}
+
+void test_ipv6_format() {
+    ipv6_addr_t addr, parsed;
+    char buf[IPV6_STRING_SIZE];
+
+    // Full groups, never compressed
+    memset(&addr, 0, sizeof(addr));
+    addr.addr[0] = 0x20;
+    addr.addr[1] = 0x01;
+    addr.addr[2] = 0x0d;
+    addr.addr[3] = 0xb8;
+    addr.addr[15] = 0x01;
+    assert(strcmp(ipv6_to_string(&addr, buf), "2001:0db8:0000:0000:0000:0000:0000:0001") == 0);
+    assert(strlen(buf) == IPV6_STRING_SIZE - 1);
+
+    // Short groups and one run of zero groups at any place
+    assert(string_to_ipv6("2001:db8::1", &parsed) == STATUS_SUCCESS);
+    assert(memcmp(&parsed, &addr, sizeof(addr)) == 0);
+    assert(string_to_ipv6(buf, &parsed) == STATUS_SUCCESS);
+    assert(memcmp(&parsed, &addr, sizeof(addr)) == 0);
+    assert(string_to_ipv6("::", &parsed) == STATUS_SUCCESS);
+    memset(&addr, 0, sizeof(addr));
+    assert(memcmp(&parsed, &addr, sizeof(addr)) == 0);
+    addr.addr[15] = 1;
+    assert(string_to_ipv6("::1", &parsed) == STATUS_SUCCESS);
+    assert(memcmp(&parsed, &addr, sizeof(addr)) == 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.addr[0] = 0xfe;
+    addr.addr[1] = 0x80;
+    assert(string_to_ipv6("FE80::", &parsed) == STATUS_SUCCESS);
+    assert(memcmp(&parsed, &addr, sizeof(addr)) == 0);
+
+    assert(string_to_ipv6("1::2::3", &parsed) == STATUS_INVALID_PARAMETER);
+    assert(string_to_ipv6("1:2:3:4:5:6:7", &parsed) == STATUS_INVALID_PARAMETER);
+    assert(string_to_ipv6("1:2:3:4:5:6:7:8:9", &parsed) == STATUS_INVALID_PARAMETER);
+    assert(string_to_ipv6("1:2:3:4:5:6:7::8", &parsed) == STATUS_INVALID_PARAMETER);
+    assert(string_to_ipv6("12345::", &parsed) == STATUS_INVALID_PARAMETER);
+    assert(string_to_ipv6("2001:db8::g", &parsed) == STATUS_INVALID_PARAMETER);
+    assert(string_to_ipv6(":1::", &parsed) == STATUS_INVALID_PARAMETER);
+    assert(string_to_ipv6(NULL, &parsed) == STATUS_INVALID_PARAMETER);
+
+    printf(TEST_PASSED, "test_ipv6_format");
+}
+
+void test_bulk_format() {
+    mac_addr_t macs[3] = { { .addr = { 0, 0, 0, 0, 0, 1 } }, { .addr = { 0, 0, 0, 0, 0, 2 } },
+                           { .addr = { 0, 0, 0, 0, 0, 3 } } };
+    ipv4_addr_t addrs[3] = { 0x0A000001u, 0x0A000002u, 0xFFFFFFFFu };
+    ipv6_addr_t v6[2];
+    char buf[128];
+    size_t length;
+
+    // Every address is followed by the separator
+    assert(mac_to_string_bulk(macs, 3, '\n', buf, sizeof(buf), &length) == 3);
+    assert(strcmp(buf, "00:00:00:00:00:01\n00:00:00:00:00:02\n00:00:00:00:00:03\n") == 0);
+    assert(length == strlen(buf));
+    assert(ipv4_to_string_bulk(addrs, 3, ' ', buf, sizeof(buf), &length) == 3);
+    assert(strcmp(buf, "10.0.0.1 10.0.0.2 255.255.255.255 ") == 0 && length == strlen(buf));
+    memset(v6, 0, sizeof(v6));
+    v6[1].addr[15] = 0xab;
+    assert(ipv6_to_string_bulk(v6, 2, ',', buf, sizeof(buf), NULL) == 2);
+    assert(strcmp(buf, "0000:0000:0000:0000:0000:0000:0000:0000,0000:0000:0000:0000:0000:0000:0000:00ab,") == 0);
+
+    // A short buffer takes whole addresses only, and is always terminated
+    assert(mac_to_string_bulk(macs, 3, '\n', buf, 2 * MAC_STRING_SIZE, &length) == 1);
+    assert(strcmp(buf, "00:00:00:00:00:01\n") == 0 && length == MAC_STRING_SIZE);
+    assert(mac_to_string_bulk(macs, 3, '\n', buf, MAC_STRING_SIZE, &length) == 0);
+    assert(buf[0] == '\0' && length == 0);
+    assert(ipv4_to_string_bulk(addrs, 3, ' ', buf, 2 * IPV4_STRING_SIZE + 1, NULL) == 2);
+    assert(strcmp(buf, "10.0.0.1 10.0.0.2 ") == 0);
+    assert(ipv4_to_string_bulk(addrs, 0, ' ', buf, sizeof(buf), &length) == 0 && length == 0);
+
+    printf(TEST_PASSED, "test_bulk_format");
+}
+
+int main() {
+    printf("Running address formatting unit tests...\n");
+
+    test_mac_format();
+    test_ipv4_format();
+    test_ipv6_format();
+    test_bulk_format();
+
+    printf("All address formatting tests completed successfully.\n");
+    return 0;
+}
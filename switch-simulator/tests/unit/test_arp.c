@@ -0,0 +1,278 @@
+/**
+ * @file test_arp.c
+ * @brief Unit tests for the ARP cache
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "../../include/l3/arp.h"
+#include "../../include/common/rcu.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define NEIGHBOR_UPDATES 20000
+#define PAGED_NEIGHBORS 4000
+#define RESIZE_NEIGHBORS 6000
+
+static const mac_addr_t g_mac_a = { .addr = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x0A } };
+static const mac_addr_t g_mac_b = { .addr = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x0B } };
+
+void test_arp_add_lookup() {
+    arp_table_t *table = arp_table_get_instance();
+    ipv4_addr_t ip = 0x0A000001;
+    ipv4_addr_t other = 0x0A000002;
+    mac_addr_t mac;
+    uint16_t port = 0;
+    arp_stats_t stats;
+
+    assert(arp_init(table) == STATUS_SUCCESS);
+
+    assert(arp_add_entry(table, &ip, &g_mac_a, 3) == STATUS_SUCCESS);
+    assert(arp_lookup(table, &ip, &mac, &port) == STATUS_SUCCESS);
+    assert(memcmp(&mac, &g_mac_a, sizeof(mac)) == 0 && port == 3);
+
+    // Updating the neighbor replaces its MAC and port
+    assert(arp_add_entry(table, &ip, &g_mac_b, 4) == STATUS_SUCCESS);
+    assert(arp_lookup(table, &ip, &mac, &port) == STATUS_SUCCESS);
+    assert(memcmp(&mac, &g_mac_b, sizeof(mac)) == 0 && port == 4);
+
+    // Unknown neighbors are not resolved from the cache
+    assert(arp_lookup(table, &other, &mac, &port) != STATUS_SUCCESS);
+
+    assert(arp_remove_entry(table, &ip) == STATUS_SUCCESS);
+    assert(arp_lookup(table, &ip, &mac, &port) != STATUS_SUCCESS);
+
+    assert(arp_get_stats(table, &stats) == STATUS_SUCCESS);
+    assert(stats.cache_hits == 2);
+
+    assert(arp_deinit(table) == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_arp_add_lookup");
+}
+
+void test_arp_rewrite() {
+    arp_table_t *table = arp_table_get_instance();
+    ipv4_addr_t ip = 0x0A000001;
+    const arp_rewrite_t *rewrite;
+    arp_rewrite_t copy;
+    uint32_t generation;
+
+    assert(arp_init(table) == STATUS_SUCCESS);
+    assert(arp_add_entry(table, &ip, &g_mac_a, 3) == STATUS_SUCCESS);
+
+    // The rewrite is the whole Ethernet header of a routed frame
+    assert(rcu_read_lock() == STATUS_SUCCESS);
+    assert(arp_get_rewrite(&ip, 3, &rewrite) == STATUS_SUCCESS);
+    copy = *rewrite;
+    rcu_read_unlock();
+    assert(copy.len == 14 && copy.port_index == 3);
+    assert(memcmp(copy.bytes, g_mac_a.addr, MAC_ADDR_LEN) == 0);
+    assert(copy.bytes[12] == 0x08 && copy.bytes[13] == 0x00);
+
+    // Changing the neighbor publishes a new rewrite and moves the generation
+    generation = arp_get_generation();
+    assert(arp_set_egress_vlan(table, &ip, 100) == STATUS_SUCCESS);
+    assert(arp_get_generation() != generation);
+
+    assert(rcu_read_lock() == STATUS_SUCCESS);
+    assert(arp_get_rewrite(&ip, 3, &rewrite) == STATUS_SUCCESS);
+    copy = *rewrite;
+    rcu_read_unlock();
+    assert(copy.len == 18);
+    assert(copy.bytes[12] == 0x81 && copy.bytes[13] == 0x00);
+    assert(copy.bytes[14] == 0x00 && copy.bytes[15] == 100);
+    assert(copy.bytes[16] == 0x08 && copy.bytes[17] == 0x00);
+
+    // Removal moves it too
+    generation = arp_get_generation();
+    assert(arp_remove_entry(table, &ip) == STATUS_SUCCESS);
+    assert(arp_get_generation() != generation);
+    assert(arp_set_egress_vlan(table, &ip, 100) == STATUS_NOT_FOUND);
+
+    assert(arp_deinit(table) == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_arp_rewrite");
+}
+
+void test_arp_neighbors_bulk() {
+    arp_table_t *table = arp_table_get_instance();
+    arp_neighbor_t neighbors[ARP_BULK_MAX + 8];
+    status_t statuses[ARP_BULK_MAX + 8];
+    arp_stats_t stats;
+    mac_addr_t mac;
+    uint16_t port;
+    uint32_t i;
+
+    assert(arp_init(table) == STATUS_SUCCESS);
+
+    // More than one lock batch
+    memset(neighbors, 0, sizeof(neighbors));
+    for (i = 0; i < ARP_BULK_MAX + 8; i++) {
+        neighbors[i].addr.ipv4 = 0x0A010000 + i;
+        neighbors[i].mac = g_mac_a;
+        neighbors[i].mac.addr[4] = (uint8_t)i;
+        neighbors[i].port_index = (uint16_t)(i % 4);
+    }
+    assert(arp_add_neighbors_bulk(table, neighbors, ARP_BULK_MAX + 8, false, statuses) == STATUS_SUCCESS);
+    for (i = 0; i < ARP_BULK_MAX + 8; i++) {
+        assert(statuses[i] == STATUS_SUCCESS);
+        assert(arp_lookup(table, &neighbors[i].addr.ipv4, &mac, &port) == STATUS_SUCCESS);
+        assert(mac.addr[4] == (uint8_t)i && port == i % 4);
+    }
+    assert(arp_get_stats(table, &stats) == STATUS_SUCCESS);
+    assert(stats.current_entries == ARP_BULK_MAX + 8);
+
+    // Removing stops at the first neighbor that is not there
+    assert(arp_remove_neighbors_bulk(table, neighbors, 2, true, NULL) == STATUS_SUCCESS);
+    assert(arp_remove_neighbors_bulk(table, neighbors, 4, true, statuses) == STATUS_NOT_FOUND);
+    assert(statuses[0] == STATUS_NOT_FOUND && statuses[1] == STATUS_NOT_EXECUTED);
+    assert(arp_get_stats(table, &stats) == STATUS_SUCCESS);
+    assert(stats.current_entries == ARP_BULK_MAX + 6);
+
+    assert(arp_deinit(table) == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_arp_neighbors_bulk");
+}
+
+static volatile int g_stop;
+
+static void *rewrite_reader(void *arg) {
+    ipv4_addr_t ip = 0x0A000001;
+    const arp_rewrite_t *rewrite;
+    uint64_t *lookups = arg;
+    mac_addr_t mac;
+    uint16_t port;
+
+    // Every read sees one of the two published neighbors, never a mix
+    do {
+        assert(arp_lookup(arp_table_get_instance(), &ip, &mac, &port) == STATUS_SUCCESS);
+        assert((memcmp(&mac, &g_mac_a, sizeof(mac)) == 0 && port == 1) ||
+               (memcmp(&mac, &g_mac_b, sizeof(mac)) == 0 && port == 2));
+
+        assert(rcu_read_lock() == STATUS_SUCCESS);
+        assert(arp_get_rewrite(&ip, 1, &rewrite) == STATUS_SUCCESS);
+        assert(rewrite->len == 14);
+        assert((memcmp(rewrite->bytes, g_mac_a.addr, MAC_ADDR_LEN) == 0 && rewrite->port_index == 1) ||
+               (memcmp(rewrite->bytes, g_mac_b.addr, MAC_ADDR_LEN) == 0 && rewrite->port_index == 2));
+        rcu_read_unlock();
+        (*lookups)++;
+    } while (!__atomic_load_n(&g_stop, __ATOMIC_ACQUIRE));
+    return NULL;
+}
+
+void test_arp_concurrent_read() {
+    arp_table_t *table = arp_table_get_instance();
+    ipv4_addr_t ip = 0x0A000001;
+    pthread_t reader;
+    uint64_t lookups = 0;
+    uint32_t i;
+
+    assert(arp_init(table) == STATUS_SUCCESS);
+    assert(arp_add_entry(table, &ip, &g_mac_a, 1) == STATUS_SUCCESS);
+
+    g_stop = 0;
+    assert(pthread_create(&reader, NULL, rewrite_reader, &lookups) == 0);
+    for (i = 0; i < NEIGHBOR_UPDATES; i++) {
+        if (i % 2) {
+            assert(arp_add_entry(table, &ip, &g_mac_a, 1) == STATUS_SUCCESS);
+        } else {
+            assert(arp_add_entry(table, &ip, &g_mac_b, 2) == STATUS_SUCCESS);
+        }
+    }
+    __atomic_store_n(&g_stop, 1, __ATOMIC_RELEASE);
+    assert(pthread_join(reader, NULL) == 0);
+    assert(lookups > 0);
+
+    assert(arp_deinit(table) == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_arp_concurrent_read");
+}
+
+/* Count each paged neighbor in entries; others must be from the second batch */
+static void count_page(const arp_entry_info_t *entries, uint32_t count, uint8_t *seen) {
+    for (uint32_t i = 0; i < count; i++) {
+        if ((entries[i].ip & 0xFFFF0000) == 0x0A020000) {
+            assert((entries[i].ip & 0xFFFF) < PAGED_NEIGHBORS);
+            assert(entries[i].port_index == (entries[i].ip & 3));
+            seen[entries[i].ip & 0xFFFF]++;
+        } else {
+            assert((entries[i].ip & 0xFFFF0000) == 0x0A030000);
+        }
+    }
+}
+
+void test_arp_pages() {
+    arp_table_t *table = arp_table_get_instance();
+    static uint8_t seen[PAGED_NEIGHBORS];
+    arp_entry_info_t entries[16];
+    table_cursor_t cursor = TABLE_CURSOR_START;
+    arp_stats_t stats;
+    uint32_t total = 0, count, i;
+    ipv4_addr_t ip;
+
+    assert(arp_init(table) == STATUS_SUCCESS);
+    for (i = 0; i < PAGED_NEIGHBORS; i++) {
+        ip = 0x0A020000 + i;
+        assert(arp_add_entry(table, &ip, &g_mac_a, (uint16_t)(i & 3)) == STATUS_SUCCESS);
+    }
+
+    // Single-entry pages return every neighbor exactly once
+    memset(seen, 0, sizeof(seen));
+    while (cursor != TABLE_CURSOR_END) {
+        assert(arp_get_entries_page(table, &cursor, entries, 1, &count) == STATUS_SUCCESS);
+        assert(count <= 1);
+        count_page(entries, count, seen);
+        total += count;
+    }
+    assert(total == PAGED_NEIGHBORS);
+    for (i = 0; i < PAGED_NEIGHBORS; i++) {
+        assert(seen[i] == 1);
+    }
+
+    // Buckets doubling halfway through may repeat a neighbor, never skip one
+    memset(seen, 0, sizeof(seen));
+    cursor = TABLE_CURSOR_START;
+    total = 0;
+    while (total < PAGED_NEIGHBORS / 2) {
+        assert(arp_get_entries_page(table, &cursor, entries, 16, &count) == STATUS_SUCCESS);
+        assert(count <= 16 && cursor != TABLE_CURSOR_END);
+        count_page(entries, count, seen);
+        total += count;
+    }
+    for (i = 0; i < RESIZE_NEIGHBORS; i++) {
+        ip = 0x0A030000 + i;
+        assert(arp_add_entry(table, &ip, &g_mac_b, 0) == STATUS_SUCCESS);
+    }
+    assert(arp_get_stats(table, &stats) == STATUS_SUCCESS);
+    assert(stats.current_entries == PAGED_NEIGHBORS + RESIZE_NEIGHBORS);
+    while (cursor != TABLE_CURSOR_END) {
+        assert(arp_get_entries_page(table, &cursor, entries, 16, &count) == STATUS_SUCCESS);
+        count_page(entries, count, seen);
+    }
+    for (i = 0; i < PAGED_NEIGHBORS; i++) {
+        assert(seen[i] >= 1);
+    }
+
+    // An ended walk stays ended, and bad arguments are refused
+    assert(arp_get_entries_page(table, &cursor, entries, 16, &count) == STATUS_SUCCESS && count == 0);
+    cursor = TABLE_CURSOR_START;
+    assert(arp_get_entries_page(table, &cursor, entries, 0, &count) == STATUS_INVALID_PARAMETER);
+    assert(arp_get_entries_page(table, NULL, entries, 16, &count) == STATUS_INVALID_PARAMETER);
+
+    assert(arp_deinit(table) == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_arp_pages");
+}
+
+int main() {
+    printf("Running ARP unit tests...\n");
+
+    test_arp_add_lookup();
+    test_arp_rewrite();
+    test_arp_neighbors_bulk();
+    test_arp_pages();
+    test_arp_concurrent_read();
+
+    printf("All ARP tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,457 @@
+/**
+ * @file test_bgp.c
+ * @brief Unit tests for BGP UPDATE processing and update groups
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/l3/bgp.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define LOCAL_AS 65000
+#define AS_A 65001
+#define AS_B 65002
+#define ADDR_A 0x0A000001           /* 10.0.0.1 */
+#define ADDR_B 0x0A000101           /* 10.0.1.1 */
+#define LOCAL_ADDR 0x0A0000FE       /* 10.0.0.254 */
+#define MAX_SENT 16
+
+/* Path attribute codes and flags (RFC 4271 4.3) */
+#define ATTR_ORIGIN 1
+#define ATTR_AS_PATH 2
+#define ATTR_NEXT_HOP 3
+#define ATTR_LOCAL_PREF 5
+#define FLAG_TRANSITIVE 0x40
+#define FLAG_EXTENDED 0x10
+#define AS_SEQUENCE 2
+
+typedef struct {
+    uint32_t addr;
+    uint8_t len;
+} prefix_t;
+
+/* What the speaker handed to the send callback */
+typedef struct {
+    uint32_t count;
+    uint32_t peer[MAX_SENT];
+    uint16_t length[MAX_SENT];
+    uint8_t msg[MAX_SENT][BGP_MAX_MESSAGE_LEN];
+} sent_t;
+
+/* One UPDATE as the test reads it back */
+typedef struct {
+    uint32_t withdrawn;
+    uint32_t nlri;
+    uint32_t first_as;
+    uint32_t as_count;
+    uint32_t next_hop;
+    bool has_local_pref;
+} update_t;
+
+static status_t capture_send(uint32_t peer_id, const uint8_t *msg, uint16_t length, void *ctx) {
+    sent_t *sent = ctx;
+
+    assert(sent->count < MAX_SENT);
+    sent->peer[sent->count] = peer_id;
+    sent->length[sent->count] = length;
+    memcpy(sent->msg[sent->count], msg, length);
+    sent->count++;
+    return STATUS_SUCCESS;
+}
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    put16(p, (uint16_t)(v >> 16));
+    put16(p + 2, (uint16_t)v);
+}
+
+static uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return (uint32_t)get16(p) << 16 | get16(p + 2);
+}
+
+static uint16_t put_prefixes(uint8_t *p, const prefix_t *prefixes, uint32_t count) {
+    uint16_t pos = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        p[pos++] = prefixes[i].len;
+        // A malformed length over 32 gets the bytes it claims, zero past the address
+        for (int b = 0; b < (prefixes[i].len + 7) / 8; b++) {
+            p[pos++] = b < 4 ? (uint8_t)(prefixes[i].addr >> (24 - 8 * b)) : 0;
+        }
+    }
+    return pos;
+}
+
+/* ORIGIN IGP, a single AS_SEQUENCE, NEXT_HOP and an optional LOCAL_PREF */
+static uint16_t make_attrs(uint8_t *p, const uint32_t *as_path, uint8_t as_count, uint32_t next_hop,
+                           uint32_t local_pref) {
+    uint16_t pos = 0;
+
+    p[pos++] = FLAG_TRANSITIVE;
+    p[pos++] = ATTR_ORIGIN;
+    p[pos++] = 1;
+    p[pos++] = BGP_ORIGIN_IGP;
+
+    p[pos++] = FLAG_TRANSITIVE;
+    p[pos++] = ATTR_AS_PATH;
+    p[pos++] = (uint8_t)(2 + as_count * 4);
+    p[pos++] = AS_SEQUENCE;
+    p[pos++] = as_count;
+    for (uint8_t i = 0; i < as_count; i++) {
+        put32(p + pos, as_path[i]);
+        pos += 4;
+    }
+
+    p[pos++] = FLAG_TRANSITIVE;
+    p[pos++] = ATTR_NEXT_HOP;
+    p[pos++] = 4;
+    put32(p + pos, next_hop);
+    pos += 4;
+
+    if (local_pref) {
+        p[pos++] = FLAG_TRANSITIVE;
+        p[pos++] = ATTR_LOCAL_PREF;
+        p[pos++] = 4;
+        put32(p + pos, local_pref);
+        pos += 4;
+    }
+    return pos;
+}
+
+static uint16_t make_update(uint8_t *msg, const prefix_t *withdrawn, uint32_t withdrawn_count,
+                            const uint8_t *attrs, uint16_t attr_len, const prefix_t *nlri, uint32_t nlri_count) {
+    uint16_t len = BGP_HEADER_LEN;
+    uint16_t withdrawn_len;
+
+    memset(msg, 0xFF, 16);
+    withdrawn_len = put_prefixes(msg + len + 2, withdrawn, withdrawn_count);
+    put16(msg + len, withdrawn_len);
+    len += 2 + withdrawn_len;
+    put16(msg + len, attr_len);
+    if (attr_len) {
+        memcpy(msg + len + 2, attrs, attr_len);
+    }
+    len += 2 + attr_len;
+    len += put_prefixes(msg + len, nlri, nlri_count);
+
+    put16(msg + 16, len);
+    msg[18] = BGP_MSG_UPDATE;
+    return len;
+}
+
+static void announce(bgp_speaker_t *speaker, uint32_t peer_id, const uint32_t *as_path, uint8_t as_count,
+                     uint32_t next_hop, const prefix_t *nlri, uint32_t nlri_count) {
+    uint8_t msg[BGP_MAX_MESSAGE_LEN];
+    uint8_t attrs[64];
+    uint16_t attr_len = make_attrs(attrs, as_path, as_count, next_hop, 0);
+    uint16_t len = make_update(msg, NULL, 0, attrs, attr_len, nlri, nlri_count);
+
+    assert(bgp_peer_input(speaker, peer_id, msg, len) == STATUS_SUCCESS);
+}
+
+static update_t read_update(const uint8_t *msg, uint16_t length) {
+    update_t update = {0};
+    uint16_t pos = BGP_HEADER_LEN;
+    uint16_t end;
+
+    assert(get16(msg + 16) == length && msg[18] == BGP_MSG_UPDATE);
+
+    end = (uint16_t)(pos + 2 + get16(msg + pos));
+    for (pos += 2; pos < end; pos += 1 + (msg[pos] + 7) / 8) {
+        update.withdrawn++;
+    }
+
+    end = (uint16_t)(pos + 2 + get16(msg + pos));
+    for (pos += 2; pos < end;) {
+        uint8_t flags = msg[pos];
+        uint8_t type = msg[pos + 1];
+        uint16_t value_len = (flags & FLAG_EXTENDED) ? get16(msg + pos + 2) : msg[pos + 2];
+        const uint8_t *value = msg + pos + ((flags & FLAG_EXTENDED) ? 4 : 3);
+
+        if (type == ATTR_AS_PATH && value_len >= 6) {
+            update.first_as = get32(value + 2);
+            update.as_count = value[1];
+        } else if (type == ATTR_NEXT_HOP) {
+            update.next_hop = get32(value);
+        } else if (type == ATTR_LOCAL_PREF) {
+            update.has_local_pref = true;
+        }
+        pos = (uint16_t)(value + value_len - msg);
+    }
+
+    for (; pos < length; pos += 1 + (msg[pos] + 7) / 8) {
+        update.nlri++;
+    }
+    return update;
+}
+
+static bgp_speaker_t *make_speaker(sent_t *sent) {
+    bgp_speaker_config_t config = {
+        .local_as = LOCAL_AS,
+        .router_id = LOCAL_ADDR,
+        .install_routes = false,
+        .send = capture_send,
+        .ctx = sent,
+    };
+    bgp_speaker_t *speaker = bgp_speaker_create(&config);
+
+    assert(speaker != NULL);
+    return speaker;
+}
+
+static uint32_t add_peer(bgp_speaker_t *speaker, uint32_t address, uint32_t remote_as, uint32_t local_address,
+                         uint32_t policy_id) {
+    bgp_peer_config_t config = {
+        .address = address,
+        .remote_as = remote_as,
+        .router_id = address,
+        .local_address = local_address,
+        .interface_index = 1,
+        .policy_id = policy_id,
+    };
+    uint32_t peer_id;
+
+    assert(bgp_peer_add(speaker, &config, &peer_id) == STATUS_SUCCESS);
+    assert(bgp_peer_set_established(speaker, peer_id, true) == STATUS_SUCCESS);
+    return peer_id;
+}
+
+static bgp_stats_t get_stats(const bgp_speaker_t *speaker) {
+    bgp_stats_t stats;
+
+    assert(bgp_get_stats(speaker, &stats) == STATUS_SUCCESS);
+    return stats;
+}
+
+void test_bgp_update_input() {
+    sent_t *sent = calloc(1, sizeof(*sent));
+    bgp_speaker_t *speaker = make_speaker(sent);
+    uint32_t peer_a = add_peer(speaker, ADDR_A, AS_A, LOCAL_ADDR, 0);
+    uint32_t peer_b = add_peer(speaker, ADDR_B, AS_B, LOCAL_ADDR, 1);
+    const uint32_t path_a[] = { AS_A, 65100 };
+    const uint32_t path_b[] = { AS_B };
+    const uint32_t path_loop[] = { AS_B, LOCAL_AS };
+    const prefix_t nlri[] = { { 0x0A010000, 16 }, { 0x0A020000, 16 }, { 0x0A030000, 24 } };
+    uint8_t msg[BGP_MAX_MESSAGE_LEN];
+    uint32_t next_hop, peer_id;
+    uint16_t len;
+
+    // Three prefixes in one message share one attribute object
+    announce(speaker, peer_a, path_a, 2, ADDR_A, nlri, 3);
+    assert(get_stats(speaker).updates_received == 1);
+    assert(get_stats(speaker).prefixes == 3 && get_stats(speaker).paths == 3);
+    assert(get_stats(speaker).attrs == 1);
+    assert(bgp_lookup(speaker, 0x0A030000, 24, &next_hop, &peer_id) == STATUS_SUCCESS);
+    assert(next_hop == ADDR_A && peer_id == peer_a);
+    assert(bgp_lookup(speaker, 0x0A030000, 16, NULL, NULL) == STATUS_NOT_FOUND);
+
+    // The shorter AS_PATH wins
+    announce(speaker, peer_b, path_b, 1, ADDR_B, &nlri[1], 1);
+    assert(get_stats(speaker).paths == 4 && get_stats(speaker).attrs == 2);
+    assert(bgp_lookup(speaker, 0x0A020000, 16, &next_hop, &peer_id) == STATUS_SUCCESS);
+    assert(next_hop == ADDR_B && peer_id == peer_b);
+
+    // A path through our own AS is treated as a withdrawal
+    announce(speaker, peer_b, path_loop, 2, ADDR_B, &nlri[1], 1);
+    assert(get_stats(speaker).paths == 3);
+    assert(bgp_lookup(speaker, 0x0A020000, 16, &next_hop, &peer_id) == STATUS_SUCCESS);
+    assert(peer_id == peer_a);
+
+    // An explicit withdrawal needs no attributes
+    len = make_update(msg, &nlri[0], 1, NULL, 0, NULL, 0);
+    assert(bgp_peer_input(speaker, peer_a, msg, len) == STATUS_SUCCESS);
+    assert(bgp_lookup(speaker, 0x0A010000, 16, NULL, NULL) == STATUS_NOT_FOUND);
+
+    // The prefix is freed once the groups have been told
+    assert(get_stats(speaker).prefixes == 3);
+    assert(bgp_speaker_flush(speaker) == STATUS_SUCCESS);
+    assert(get_stats(speaker).prefixes == 2);
+
+    // Messages other than UPDATE are left to the session
+    msg[18] = BGP_MSG_KEEPALIVE;
+    put16(msg + 16, BGP_HEADER_LEN);
+    assert(bgp_peer_input(speaker, peer_a, msg, BGP_HEADER_LEN) == STATUS_SUCCESS);
+    assert(get_stats(speaker).updates_received == 4);
+
+    bgp_speaker_destroy(speaker);
+    free(sent);
+    printf(TEST_PASSED, "test_bgp_update_input");
+}
+
+void test_bgp_malformed_update() {
+    sent_t *sent = calloc(1, sizeof(*sent));
+    bgp_speaker_t *speaker = make_speaker(sent);
+    uint32_t peer_a = add_peer(speaker, ADDR_A, AS_A, LOCAL_ADDR, 0);
+    const uint32_t path_a[] = { AS_A };
+    const uint32_t path_b[] = { AS_B };
+    const prefix_t nlri = { 0x0A010000, 16 };
+    const prefix_t too_long = { 0x0A010000, 33 };
+    uint8_t msg[BGP_MAX_MESSAGE_LEN];
+    uint8_t attrs[64];
+    uint16_t attr_len, len;
+    bgp_peer_config_t idle = { .address = ADDR_B, .remote_as = AS_B };
+    uint32_t peer_idle;
+
+    // Header length disagrees with what was received
+    attr_len = make_attrs(attrs, path_a, 1, ADDR_A, 0);
+    len = make_update(msg, NULL, 0, attrs, attr_len, &nlri, 1);
+    assert(bgp_peer_input(speaker, peer_a, msg, (uint16_t)(len - 1)) == STATUS_INVALID_PARAMETER);
+
+    // Prefix length over 32
+    len = make_update(msg, NULL, 0, attrs, attr_len, &too_long, 1);
+    assert(bgp_peer_input(speaker, peer_a, msg, len) == STATUS_INVALID_PARAMETER);
+
+    // An attribute that runs past the attribute field
+    attrs[2] = 40;
+    len = make_update(msg, NULL, 0, attrs, attr_len, &nlri, 1);
+    assert(bgp_peer_input(speaker, peer_a, msg, len) == STATUS_INVALID_PARAMETER);
+
+    // NEXT_HOP is mandatory
+    attr_len = make_attrs(attrs, path_a, 1, ADDR_A, 0);
+    len = make_update(msg, NULL, 0, attrs, (uint16_t)(attr_len - 7), &nlri, 1);
+    assert(bgp_peer_input(speaker, peer_a, msg, len) == STATUS_INVALID_PARAMETER);
+
+    // An eBGP peer must put its own AS first
+    attr_len = make_attrs(attrs, path_b, 1, ADDR_A, 0);
+    len = make_update(msg, NULL, 0, attrs, attr_len, &nlri, 1);
+    assert(bgp_peer_input(speaker, peer_a, msg, len) == STATUS_INVALID_PARAMETER);
+
+    // None of it reached the table
+    assert(get_stats(speaker).malformed_updates == 5);
+    assert(get_stats(speaker).prefixes == 0 && get_stats(speaker).attrs == 0);
+
+    // Only Established peers are listened to
+    assert(bgp_peer_add(speaker, &idle, &peer_idle) == STATUS_SUCCESS);
+    attr_len = make_attrs(attrs, path_b, 1, ADDR_B, 0);
+    len = make_update(msg, NULL, 0, attrs, attr_len, &nlri, 1);
+    assert(bgp_peer_input(speaker, peer_idle, msg, len) == STATUS_NOT_FOUND);
+    assert(bgp_peer_input(speaker, BGP_MAX_PEERS, msg, len) == STATUS_NOT_FOUND);
+
+    bgp_speaker_destroy(speaker);
+    free(sent);
+    printf(TEST_PASSED, "test_bgp_malformed_update");
+}
+
+void test_bgp_update_groups() {
+    sent_t *sent = calloc(1, sizeof(*sent));
+    bgp_speaker_t *speaker = make_speaker(sent);
+    uint32_t peer_a = add_peer(speaker, ADDR_A, AS_A, LOCAL_ADDR, 0);
+    uint32_t peer_b = add_peer(speaker, ADDR_B, AS_B, LOCAL_ADDR, 0);
+    uint32_t peer_i;
+    const uint32_t origin_as[] = { 65100 };
+    bgp_route_attr_t shared = { .origin = BGP_ORIGIN_IGP, .as_path = origin_as, .as_path_len = 1 };
+    bgp_route_attr_t other = { .origin = BGP_ORIGIN_INCOMPLETE };
+    bgp_stats_t stats;
+    update_t update;
+
+    // Peers with the same policy are one group
+    assert(get_stats(speaker).update_groups == 1);
+
+    assert(bgp_announce(speaker, 0x0A010000, 16, &shared, 1) == STATUS_SUCCESS);
+    assert(bgp_announce(speaker, 0x0A020000, 16, &shared, 1) == STATUS_SUCCESS);
+    assert(bgp_announce(speaker, 0x0A030000, 24, &shared, 1) == STATUS_SUCCESS);
+    assert(bgp_announce(speaker, 0x0A040000, 16, &other, 1) == STATUS_SUCCESS);
+    assert(bgp_lookup(speaker, 0x0A040000, 16, NULL, &peer_i) == STATUS_SUCCESS);
+    assert(peer_i == BGP_MAX_PEERS);
+
+    // Nothing goes out until the flush
+    assert(sent->count == 0);
+    assert(bgp_speaker_flush(speaker) == STATUS_SUCCESS);
+
+    // One message per attribute set, formatted once for the group and sent to both members
+    stats = get_stats(speaker);
+    assert(stats.updates_formatted == 2 && stats.messages_sent == 4);
+    assert(stats.nlri_sent == 4);
+    assert(sent->count == 4);
+    for (uint32_t i = 0; i < sent->count; i++) {
+        assert(sent->peer[i] == peer_a || sent->peer[i] == peer_b);
+        update = read_update(sent->msg[i], sent->length[i]);
+        assert(update.nlri == 3 || update.nlri == 1);
+        assert(update.first_as == LOCAL_AS);
+        assert(update.as_count == (update.nlri == 3 ? 2 : 1));
+        assert(update.next_hop == LOCAL_ADDR && !update.has_local_pref);
+    }
+
+    // A withdrawal goes out on its own
+    sent->count = 0;
+    assert(bgp_withdraw(speaker, 0x0A020000, 16) == STATUS_SUCCESS);
+    assert(bgp_withdraw(speaker, 0x0A020000, 16) == STATUS_NOT_FOUND);
+    assert(bgp_speaker_flush(speaker) == STATUS_SUCCESS);
+    assert(sent->count == 2);
+    update = read_update(sent->msg[0], sent->length[0]);
+    assert(update.withdrawn == 1 && update.nlri == 0);
+    assert(get_stats(speaker).withdrawn_sent == 1);
+
+    // A new iBGP peer is its own group and gets the whole table at once
+    sent->count = 0;
+    peer_i = add_peer(speaker, 0x0A000201, LOCAL_AS, LOCAL_ADDR, 0);
+    assert(get_stats(speaker).update_groups == 2);
+    assert(sent->count == 2);
+    for (uint32_t i = 0; i < sent->count; i++) {
+        assert(sent->peer[i] == peer_i);
+        update = read_update(sent->msg[i], sent->length[i]);
+        assert(update.nlri == 2 || update.nlri == 1);
+        assert(update.has_local_pref && update.next_hop == LOCAL_ADDR);
+        assert(update.as_count == (update.nlri == 2 ? 1 : 0));
+    }
+
+    bgp_speaker_destroy(speaker);
+    free(sent);
+    printf(TEST_PASSED, "test_bgp_update_groups");
+}
+
+void test_bgp_peer_down() {
+    sent_t *sent = calloc(1, sizeof(*sent));
+    bgp_speaker_t *speaker = make_speaker(sent);
+    uint32_t peer_a = add_peer(speaker, ADDR_A, AS_A, LOCAL_ADDR, 0);
+    uint32_t peer_b = add_peer(speaker, ADDR_B, AS_B, LOCAL_ADDR, 1);
+    const uint32_t path_a[] = { AS_A };
+    const uint32_t path_b[] = { AS_B, 65100 };
+    const prefix_t nlri[] = { { 0x0A010000, 16 }, { 0x0A020000, 16 } };
+    uint32_t peer_id;
+
+    announce(speaker, peer_a, path_a, 1, ADDR_A, nlri, 2);
+    announce(speaker, peer_b, path_b, 2, ADDR_B, nlri, 1);
+    assert(bgp_lookup(speaker, 0x0A010000, 16, NULL, &peer_id) == STATUS_SUCCESS && peer_id == peer_a);
+
+    // The session drops: its paths go and the backup takes over
+    assert(bgp_peer_set_established(speaker, peer_a, false) == STATUS_SUCCESS);
+    assert(bgp_lookup(speaker, 0x0A010000, 16, NULL, &peer_id) == STATUS_SUCCESS && peer_id == peer_b);
+    assert(bgp_lookup(speaker, 0x0A020000, 16, NULL, NULL) == STATUS_NOT_FOUND);
+    assert(get_stats(speaker).paths == 1 && get_stats(speaker).attrs == 1);
+
+    // Removing the last peer empties the table
+    assert(bgp_peer_remove(speaker, peer_b) == STATUS_SUCCESS);
+    assert(bgp_peer_remove(speaker, peer_b) == STATUS_NOT_FOUND);
+    assert(get_stats(speaker).prefixes == 0 && get_stats(speaker).attrs == 0);
+    assert(get_stats(speaker).update_groups == 1);
+
+    bgp_speaker_destroy(speaker);
+    free(sent);
+    printf(TEST_PASSED, "test_bgp_peer_down");
+}
+
+int main() {
+    printf("Running BGP unit tests...\n");
+
+    test_bgp_update_input();
+    test_bgp_malformed_update();
+    test_bgp_update_groups();
+    test_bgp_peer_down();
+
+    printf("All BGP tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,164 @@
+/**
+ * @file test_bsp_resources.c
+ * @brief Unit tests for the BSP resource pools
+ *
+ * bsp_init.c is not part of the test library, so the pools are built
+ * straight from a board profile and the test stands in for the BSP's
+ * initialized flag.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../bsp/include/bsp.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define TCAM_SLICES 4
+#define TCAM_ROWS 512
+#define COUNTER_BANKS 8
+
+extern bsp_error_t bsp_resource_pools_init(const bsp_config_t* config);
+extern void bsp_cleanup_resources(void);
+
+static bool g_initialized;
+
+bool bsp_is_initialized(void) {
+    return g_initialized;
+}
+
+static void board_profile(bsp_config_t *config) {
+    memset(config, 0, sizeof(*config));
+    config->resources[BSP_RESOURCE_TYPE_TCAM_SLICE].count = TCAM_SLICES;
+    config->resources[BSP_RESOURCE_TYPE_TCAM_SLICE].entries = TCAM_ROWS;
+    config->resources[BSP_RESOURCE_TYPE_COUNTER_BANK].count = COUNTER_BANKS;
+    config->resources[BSP_RESOURCE_TYPE_BUFFER].count = 2;
+    config->resources[BSP_RESOURCE_TYPE_BUFFER].unit_size = BSP_BUFFER_CELL_SIZE;
+}
+
+void test_bsp_pool_setup() {
+    bsp_resource_usage_t usage;
+    bsp_resource_handle_t handle;
+    bsp_config_t config;
+
+    board_profile(&config);
+    assert(bsp_resource_pools_init(NULL) == BSP_ERROR_INVALID_PARAM);
+    assert(bsp_resource_pools_init(&config) == BSP_SUCCESS);
+
+    // Nothing is handed out before the BSP is up
+    assert(bsp_allocate_resource(BSP_RESOURCE_TYPE_TCAM_SLICE, 0, &handle) == BSP_ERROR_NOT_INITIALIZED);
+    assert(bsp_get_resource_usage(BSP_RESOURCE_TYPE_TCAM_SLICE, &usage) == BSP_ERROR_NOT_INITIALIZED);
+    g_initialized = true;
+
+    // Occupancy comes from the profile
+    assert(bsp_get_resource_usage(BSP_RESOURCE_TYPE_TCAM_SLICE, &usage) == BSP_SUCCESS);
+    assert(usage.total == TCAM_SLICES && usage.used == 0 && usage.entries == TCAM_ROWS);
+    assert(bsp_get_resource_usage(BSP_RESOURCE_TYPE_QUEUE, &usage) == BSP_SUCCESS);
+    assert(usage.total == 0);
+    assert(bsp_get_resource_usage(BSP_RESOURCE_TYPE_COUNT, &usage) == BSP_ERROR_INVALID_PARAM);
+    assert(bsp_get_resource_usage(BSP_RESOURCE_TYPE_BUFFER, NULL) == BSP_ERROR_INVALID_PARAM);
+
+    printf(TEST_PASSED, "test_bsp_pool_setup");
+}
+
+void test_bsp_allocate_free() {
+    bsp_resource_handle_t slices[TCAM_SLICES];
+    bsp_resource_handle_t handle;
+    bsp_resource_usage_t usage;
+
+    // A pool runs dry at its board size, and counts what it refused
+    for (uint32_t i = 0; i < TCAM_SLICES; i++) {
+        assert(bsp_allocate_resource(BSP_RESOURCE_TYPE_TCAM_SLICE, 0, &slices[i]) == BSP_SUCCESS);
+        assert(bsp_resource_data(slices[i]) == NULL);
+        for (uint32_t j = 0; j < i; j++) {
+            assert(slices[j] != slices[i]);
+        }
+    }
+    assert(bsp_allocate_resource(BSP_RESOURCE_TYPE_TCAM_SLICE, 0, &handle) == BSP_ERROR_RESOURCE_UNAVAILABLE);
+    assert(bsp_allocate_resource(BSP_RESOURCE_TYPE_QUEUE, 0, &handle) == BSP_ERROR_RESOURCE_UNAVAILABLE);
+    assert(bsp_get_resource_usage(BSP_RESOURCE_TYPE_TCAM_SLICE, &usage) == BSP_SUCCESS);
+    assert(usage.used == TCAM_SLICES && usage.peak == TCAM_SLICES && usage.failures == 1);
+
+    // The unit freed last is the next one handed out
+    assert(bsp_free_resource(slices[1]) == BSP_SUCCESS);
+    assert(bsp_free_resource(slices[1]) == BSP_ERROR_INVALID_PARAM);
+    assert(bsp_allocate_resource(BSP_RESOURCE_TYPE_TCAM_SLICE, 0, &handle) == BSP_SUCCESS);
+    assert(handle == slices[1]);
+
+    for (uint32_t i = 0; i < TCAM_SLICES; i++) {
+        assert(bsp_free_resource(slices[i]) == BSP_SUCCESS);
+    }
+    assert(bsp_get_resource_usage(BSP_RESOURCE_TYPE_TCAM_SLICE, &usage) == BSP_SUCCESS);
+    assert(usage.used == 0 && usage.peak == TCAM_SLICES);
+
+    // Handles that are not units of any pool
+    assert(bsp_free_resource(NULL) == BSP_ERROR_INVALID_PARAM);
+    assert(bsp_free_resource(&usage) == BSP_ERROR_INVALID_PARAM);
+    assert(bsp_allocate_resource(BSP_RESOURCE_TYPE_COUNT, 0, &handle) == BSP_ERROR_INVALID_PARAM);
+    assert(bsp_allocate_resource(BSP_RESOURCE_TYPE_COUNTER_BANK, 0, NULL) == BSP_ERROR_INVALID_PARAM);
+
+    printf(TEST_PASSED, "test_bsp_allocate_free");
+}
+
+void test_bsp_unit_memory() {
+    bsp_resource_handle_t a, b, handle;
+    uint8_t *data;
+
+    // Units with memory hold at most their size, zeroed at allocation
+    assert(bsp_allocate_resource(BSP_RESOURCE_TYPE_BUFFER, BSP_BUFFER_CELL_SIZE + 1, &handle) ==
+           BSP_ERROR_INVALID_PARAM);
+    assert(bsp_allocate_resource(BSP_RESOURCE_TYPE_BUFFER, BSP_BUFFER_CELL_SIZE, &a) == BSP_SUCCESS);
+    assert(bsp_allocate_resource(BSP_RESOURCE_TYPE_BUFFER, 100, &b) == BSP_SUCCESS);
+    data = bsp_resource_data(a);
+    assert(data != NULL && bsp_resource_data(b) != NULL && bsp_resource_data(b) != (void *)data);
+    for (uint32_t i = 0; i < BSP_BUFFER_CELL_SIZE; i++) {
+        assert(data[i] == 0);
+    }
+    memset(data, 0xa5, BSP_BUFFER_CELL_SIZE);
+
+    assert(bsp_free_resource(a) == BSP_SUCCESS);
+    assert(bsp_resource_data(a) == NULL);
+    assert(bsp_allocate_resource(BSP_RESOURCE_TYPE_BUFFER, 0, &handle) == BSP_SUCCESS);
+    assert(handle == a && bsp_resource_data(handle) == (void *)data);
+    assert(data[0] == 0 && data[BSP_BUFFER_CELL_SIZE - 1] == 0);
+    assert(bsp_free_resource(handle) == BSP_SUCCESS);
+    assert(bsp_free_resource(b) == BSP_SUCCESS);
+
+    printf(TEST_PASSED, "test_bsp_unit_memory");
+}
+
+void test_bsp_cleanup() {
+    bsp_resource_usage_t usage;
+    bsp_resource_handle_t handle;
+    bsp_config_t config;
+
+    // Rebuilding the pools from a new profile resizes them, every unit free
+    board_profile(&config);
+    config.resources[BSP_RESOURCE_TYPE_TCAM_SLICE].count = 1;
+    assert(bsp_resource_pools_init(&config) == BSP_SUCCESS);
+    assert(bsp_get_resource_usage(BSP_RESOURCE_TYPE_TCAM_SLICE, &usage) == BSP_SUCCESS);
+    assert(usage.total == 1 && usage.used == 0 && usage.peak == 0 && usage.failures == 0);
+    assert(bsp_allocate_resource(BSP_RESOURCE_TYPE_TCAM_SLICE, 0, &handle) == BSP_SUCCESS);
+
+    bsp_cleanup_resources();
+    assert(bsp_free_resource(handle) == BSP_ERROR_INVALID_PARAM);
+    assert(bsp_get_resource_usage(BSP_RESOURCE_TYPE_TCAM_SLICE, &usage) == BSP_SUCCESS);
+    assert(usage.total == 0);
+    g_initialized = false;
+
+    printf(TEST_PASSED, "test_bsp_cleanup");
+}
+
+int main() {
+    printf("Running BSP resource unit tests...\n");
+
+    test_bsp_pool_setup();
+    test_bsp_allocate_free();
+    test_bsp_unit_memory();
+    test_bsp_cleanup();
+
+    printf("All BSP resource tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,349 @@
+/**
+ * @file test_bulk_api.c
+ * @brief Unit tests for the column-array bulk table API
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <arpa/inet.h>
+#include "../../include/management/bulk_api.h"
+#include "../../include/l2/mac_table.h"
+#include "../../include/l2/vlan.h"
+#include "../../include/l3/routing_table.h"
+#include "../../include/hal/port.h"
+#include "../../include/hal/hw_resources.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define NUM_PORTS 8
+#define ROUTES 300
+#define MACS 200
+#define PAGE 7
+#define TEST_VLAN 10
+
+/* Columns of one table, with room for rows */
+typedef struct {
+    uint8_t prefix[ROUTES + 2][BULK_ADDR_LEN];
+    uint8_t next_hop[ROUTES + 2][BULK_ADDR_LEN];
+    uint8_t is_ipv6[ROUTES + 2];
+    uint8_t prefix_len[ROUTES + 2];
+    uint16_t interface[ROUTES + 2];
+    uint16_t metric[ROUTES + 2];
+    uint8_t source[ROUTES + 2];
+    status_t statuses[ROUTES + 2];
+} route_rows_t;
+
+typedef struct {
+    uint8_t mac[MACS][MAC_ADDR_LEN];
+    uint16_t vlan_id[MACS];
+    uint16_t port_id[MACS];
+    uint8_t type[MACS];
+    uint32_t age_timestamp[MACS];
+    status_t statuses[MACS];
+} mac_rows_t;
+
+static routing_table_t g_table;
+
+static bulk_route_columns_t route_columns(route_rows_t *rows) {
+    bulk_route_columns_t columns = {
+        .prefix = rows->prefix, .next_hop = rows->next_hop, .is_ipv6 = rows->is_ipv6,
+        .prefix_len = rows->prefix_len, .interface = rows->interface, .metric = rows->metric,
+        .source = rows->source,
+    };
+    return columns;
+}
+
+static bulk_mac_columns_t mac_columns(mac_rows_t *rows) {
+    bulk_mac_columns_t columns = {
+        .mac = rows->mac, .vlan_id = rows->vlan_id, .port_id = rows->port_id,
+        .type = rows->type, .age_timestamp = rows->age_timestamp,
+    };
+    return columns;
+}
+
+/* Route i: 10.(i/256).(i%256).0/24 via 192.168.1.1 on interface 1 + i % 4 */
+static void fill_routes(route_rows_t *rows) {
+    memset(rows, 0, sizeof(*rows));
+    for (uint32_t i = 0; i < ROUTES; i++) {
+        rows->prefix[i][0] = 10;
+        rows->prefix[i][1] = (uint8_t)(i / 256);
+        rows->prefix[i][2] = (uint8_t)(i % 256);
+        rows->prefix_len[i] = 24;
+        rows->next_hop[i][0] = 192;
+        rows->next_hop[i][1] = 168;
+        rows->next_hop[i][2] = 1;
+        rows->next_hop[i][3] = 1;
+        rows->interface[i] = (uint16_t)(1 + i % 4);
+        rows->metric[i] = (uint16_t)i;
+        rows->source[i] = ROUTE_TYPE_STATIC;
+    }
+
+    // One IPv6 row, and one that is not a prefix
+    assert(inet_pton(AF_INET6, "2001:db8::", rows->prefix[ROUTES]) == 1);
+    assert(inet_pton(AF_INET6, "fe80::1", rows->next_hop[ROUTES]) == 1);
+    rows->is_ipv6[ROUTES] = 1;
+    rows->prefix_len[ROUTES] = 32;
+    rows->interface[ROUTES] = 2;
+    rows->source[ROUTES] = ROUTE_TYPE_STATIC;
+    rows->prefix_len[ROUTES + 1] = 33;
+}
+
+static bool route_row_seen(const route_rows_t *rows, uint32_t count, uint32_t i) {
+    for (uint32_t r = 0; r < count; r++) {
+        if (memcmp(rows->prefix[r], (uint8_t[]){ 10, (uint8_t)(i / 256), (uint8_t)(i % 256), 0 }, 4) == 0 &&
+            !rows->is_ipv6[r]) {
+            return rows->prefix_len[r] == 24 && rows->interface[r] == 1 + i % 4 && rows->metric[r] == i;
+        }
+    }
+    return false;
+}
+
+static void mac_of(uint32_t i, uint8_t *mac) {
+    mac[0] = 0x02;
+    mac[1] = 0x00;
+    mac[2] = 0x00;
+    mac[3] = (uint8_t)(i >> 16);
+    mac[4] = (uint8_t)(i >> 8);
+    mac[5] = (uint8_t)i;
+}
+
+void test_bulk_routes() {
+    route_rows_t *rows = (route_rows_t *)malloc(sizeof(route_rows_t));
+    route_rows_t *read = (route_rows_t *)calloc(1, sizeof(route_rows_t));
+    bulk_route_columns_t columns;
+    bulk_route_columns_t out;
+    table_cursor_t cursor = TABLE_CURSOR_START;
+    uint32_t count;
+    uint32_t total = 0;
+    bool seen[ROUTES];
+
+    assert(rows && read);
+    fill_routes(rows);
+    columns = route_columns(rows);
+    out = route_columns(read);
+
+    // Good rows go in one batch; a bad row only fails itself
+    assert(bulk_update_routes(&columns, ROUTES + 2, false, rows->statuses) == STATUS_INVALID_PARAMETER);
+    for (uint32_t i = 0; i <= ROUTES; i++) {
+        assert(rows->statuses[i] == STATUS_SUCCESS);
+    }
+    assert(rows->statuses[ROUTES + 1] == STATUS_INVALID_PARAMETER);
+
+    // A read that does not fit says how many rows it needs
+    assert(bulk_read_routes(&out, 10, &count) == STATUS_OUT_OF_BOUNDS && count == ROUTES + 1);
+    assert(bulk_read_routes(&out, ROUTES + 2, &count) == STATUS_SUCCESS && count == ROUTES + 1);
+    for (uint32_t i = 0; i < ROUTES; i++) {
+        assert(route_row_seen(read, count, i));
+    }
+    for (uint32_t r = 0; r < count; r++) {
+        if (read->is_ipv6[r]) {
+            assert(memcmp(read->prefix[r], rows->prefix[ROUTES], BULK_ADDR_LEN) == 0);
+            assert(memcmp(read->next_hop[r], rows->next_hop[ROUTES], BULK_ADDR_LEN) == 0);
+            assert(read->prefix_len[r] == 32 && read->source[r] == ROUTE_TYPE_STATIC);
+        }
+    }
+
+    // Pages of a fixed size return every route once
+    memset(seen, 0, sizeof(seen));
+    while (cursor != TABLE_CURSOR_END) {
+        assert(bulk_read_routes_page(&out, PAGE, &cursor, &count) == STATUS_SUCCESS);
+        assert(count <= PAGE);
+        for (uint32_t r = 0; r < count; r++) {
+            if (!read->is_ipv6[r]) {
+                uint32_t i = read->prefix[r][1] * 256u + read->prefix[r][2];
+                assert(i < ROUTES && !seen[i]);
+                seen[i] = true;
+            }
+        }
+        total += count;
+    }
+    assert(total == ROUTES + 1);
+
+    // Columns left out are not written
+    out.next_hop = NULL;
+    out.metric = NULL;
+    read->metric[0] = 0xBEEF;
+    assert(bulk_read_routes(&out, ROUTES + 2, &count) == STATUS_SUCCESS);
+    assert(read->metric[0] == 0xBEEF);
+
+    // Removal takes the prefixes out again
+    assert(bulk_update_routes(&columns, ROUTES + 1, true, NULL) == STATUS_SUCCESS);
+    assert(bulk_read_routes(&out, ROUTES + 2, &count) == STATUS_SUCCESS && count == 0);
+
+    assert(bulk_update_routes(NULL, 1, false, NULL) == STATUS_INVALID_PARAMETER);
+    columns.prefix_len = NULL;
+    assert(bulk_update_routes(&columns, 1, false, NULL) == STATUS_INVALID_PARAMETER);
+    assert(bulk_update_routes(&columns, 0, false, NULL) == STATUS_SUCCESS);
+    assert(bulk_read_routes(&out, 1, NULL) == STATUS_INVALID_PARAMETER);
+
+    free(rows);
+    free(read);
+    printf(TEST_PASSED, "test_bulk_routes");
+}
+
+void test_bulk_mac_entries() {
+    mac_rows_t *rows = (mac_rows_t *)calloc(1, sizeof(mac_rows_t));
+    mac_rows_t *read = (mac_rows_t *)calloc(1, sizeof(mac_rows_t));
+    bulk_mac_columns_t columns;
+    bulk_mac_columns_t out;
+    table_cursor_t cursor = TABLE_CURSOR_START;
+    uint32_t count;
+    uint32_t total = 0;
+    bool seen[MACS];
+
+    assert(rows && read);
+    for (uint32_t i = 0; i < MACS; i++) {
+        mac_of(MACS - 1 - i, rows->mac[i]);
+        rows->vlan_id[i] = TEST_VLAN;
+        rows->port_id[i] = (uint16_t)(1 + i % 4);
+    }
+    columns = mac_columns(rows);
+    out = mac_columns(read);
+
+    assert(bulk_update_mac_entries(&columns, MACS, false, rows->statuses) == STATUS_SUCCESS);
+    for (uint32_t i = 0; i < MACS; i++) {
+        assert(rows->statuses[i] == STATUS_SUCCESS);
+    }
+
+    // The snapshot read is sorted by address
+    assert(bulk_read_mac_entries(&out, MACS - 1, &count) == STATUS_OUT_OF_BOUNDS && count == MACS);
+    assert(bulk_read_mac_entries(&out, MACS, &count) == STATUS_SUCCESS && count == MACS);
+    for (uint32_t r = 0; r < MACS; r++) {
+        uint8_t mac[MAC_ADDR_LEN];
+
+        mac_of(r, mac);
+        assert(memcmp(read->mac[r], mac, MAC_ADDR_LEN) == 0);
+        assert(read->vlan_id[r] == TEST_VLAN && read->type[r] == MAC_ENTRY_TYPE_STATIC);
+        assert(read->port_id[r] == 1 + (MACS - 1 - r) % 4);
+    }
+
+    // Pages return every entry once, in table order
+    memset(seen, 0, sizeof(seen));
+    while (cursor != TABLE_CURSOR_END) {
+        assert(bulk_read_mac_entries_page(&out, PAGE, &cursor, &count) == STATUS_SUCCESS);
+        for (uint32_t r = 0; r < count; r++) {
+            uint32_t i = (uint32_t)read->mac[r][4] << 8 | read->mac[r][5];
+            assert(i < MACS && !seen[i]);
+            seen[i] = true;
+        }
+        total += count;
+    }
+    assert(total == MACS);
+
+    // Deletion needs no port; a second one finds nothing
+    columns.port_id = NULL;
+    assert(bulk_update_mac_entries(&columns, MACS, true, rows->statuses) == STATUS_SUCCESS);
+    assert(bulk_read_mac_entries(&out, MACS, &count) == STATUS_SUCCESS && count == 0);
+    assert(bulk_update_mac_entries(&columns, 1, true, rows->statuses) != STATUS_SUCCESS);
+    assert(rows->statuses[0] != STATUS_SUCCESS);
+    assert(bulk_update_mac_entries(&columns, 1, false, NULL) == STATUS_INVALID_PARAMETER);
+
+    free(rows);
+    free(read);
+    printf(TEST_PASSED, "test_bulk_mac_entries");
+}
+
+void test_bulk_vlan_members() {
+    uint16_t vlan_ids[4] = { TEST_VLAN, TEST_VLAN, TEST_VLAN, 999 };
+    uint16_t port_ids[4] = { 2, 3, 5, 1 };
+    uint8_t tagged[4] = { 1, 0, 1, 0 };
+    status_t statuses[4];
+    bulk_vlan_member_columns_t columns = { .vlan_id = vlan_ids, .port_id = port_ids, .tagged = tagged };
+    uint16_t read_vlans[NUM_PORTS * 2];
+    uint16_t read_ports[NUM_PORTS * 2];
+    uint8_t read_tagged[NUM_PORTS * 2];
+    bulk_vlan_member_columns_t out = { .vlan_id = read_vlans, .port_id = read_ports, .tagged = read_tagged };
+    uint32_t count;
+    uint32_t default_members;
+
+    assert(vlan_create(TEST_VLAN, "bulk") == STATUS_SUCCESS);
+
+    // Each row has its own outcome; a VLAN that does not exist fails alone
+    assert(bulk_update_vlan_members(&columns, 4, false, statuses) != STATUS_SUCCESS);
+    assert(statuses[0] == STATUS_SUCCESS && statuses[1] == STATUS_SUCCESS && statuses[2] == STATUS_SUCCESS);
+    assert(statuses[3] != STATUS_SUCCESS);
+
+    // Read by VLAN, then port
+    assert(bulk_read_vlan_members(&out, 1, &count) == STATUS_OUT_OF_BOUNDS);
+    default_members = count - 3;
+    assert(bulk_read_vlan_members(&out, NUM_PORTS * 2, &count) == STATUS_SUCCESS);
+    assert(count == default_members + 3);
+    for (uint32_t r = 0; r < default_members; r++) {
+        assert(read_vlans[r] == VLAN_ID_DEFAULT);
+    }
+    assert(read_vlans[default_members] == TEST_VLAN && read_ports[default_members] == 2 &&
+           read_tagged[default_members] == 1);
+    assert(read_ports[default_members + 1] == 3 && read_tagged[default_members + 1] == 0);
+    assert(read_ports[default_members + 2] == 5 && read_tagged[default_members + 2] == 1);
+
+    // Removal ignores the tagging
+    columns.tagged = NULL;
+    assert(bulk_update_vlan_members(&columns, 3, true, statuses) == STATUS_SUCCESS);
+    assert(bulk_read_vlan_members(&out, NUM_PORTS * 2, &count) == STATUS_SUCCESS && count == default_members);
+
+    columns.port_id = NULL;
+    assert(bulk_update_vlan_members(&columns, 1, false, NULL) == STATUS_INVALID_PARAMETER);
+    assert(bulk_update_vlan_members(&columns, 0, false, NULL) == STATUS_SUCCESS);
+
+    printf(TEST_PASSED, "test_bulk_vlan_members");
+}
+
+void test_bulk_counters() {
+    const uint16_t ports[3] = { 1, 9999, 2 };
+    const uint16_t vlans[2] = { VLAN_ID_INVALID, TEST_VLAN };
+    uint64_t port_counters[BULK_PORT_COUNTER_COUNT * 3];
+    uint64_t vlan_counters[BULK_VLAN_COUNTER_COUNT * 2];
+    status_t statuses[3];
+    port_stats_t stats;
+
+    // The matrix is one row per counter, one column per port
+    memset(port_counters, 0xFF, sizeof(port_counters));
+    assert(bulk_read_port_counters(ports, 3, port_counters, statuses) != STATUS_SUCCESS);
+    assert(statuses[0] == STATUS_SUCCESS && statuses[1] != STATUS_SUCCESS && statuses[2] == STATUS_SUCCESS);
+    assert(port_get_stats(2, &stats) == STATUS_SUCCESS);
+    assert(port_counters[BULK_PORT_RX_PACKETS * 3 + 2] == stats.rx_packets);
+    assert(port_counters[BULK_PORT_TX_BYTES * 3 + 2] == stats.tx_bytes);
+    for (uint32_t c = 0; c < BULK_PORT_COUNTER_COUNT; c++) {
+        assert(port_counters[c * 3 + 1] == 0);
+    }
+
+    // An invalid VLAN ID reads as zeros; no traffic has been counted yet
+    memset(vlan_counters, 0xFF, sizeof(vlan_counters));
+    assert(bulk_read_vlan_counters(vlans, 2, vlan_counters, statuses) != STATUS_SUCCESS);
+    assert(statuses[0] != STATUS_SUCCESS && statuses[1] == STATUS_SUCCESS);
+    for (uint32_t c = 0; c < BULK_VLAN_COUNTER_COUNT; c++) {
+        assert(vlan_counters[c * 2] == 0 && vlan_counters[c * 2 + 1] == 0);
+    }
+
+    assert(bulk_read_port_counters(NULL, 1, port_counters, NULL) == STATUS_INVALID_PARAMETER);
+    assert(bulk_read_port_counters(ports, 0, NULL, NULL) == STATUS_SUCCESS);
+
+    printf(TEST_PASSED, "test_bulk_counters");
+}
+
+int main() {
+    printf("Running bulk API unit tests...\n");
+
+    // Routes reserve hardware entries; MAC entries need ports the port layer knows
+    assert(hw_resources_init() == STATUS_SUCCESS);
+    assert(port_init() == STATUS_SUCCESS);
+    assert(vlan_init(NUM_PORTS) == STATUS_SUCCESS);
+    assert(mac_table_init(1024, 300) == STATUS_SUCCESS);
+    assert(routing_table_init(&g_table) == STATUS_SUCCESS);
+
+    test_bulk_routes();
+    test_bulk_mac_entries();
+    test_bulk_vlan_members();
+    test_bulk_counters();
+
+    assert(routing_table_cleanup() == STATUS_SUCCESS);
+    assert(mac_table_deinit() == STATUS_SUCCESS);
+    assert(vlan_deinit() == STATUS_SUCCESS);
+
+    printf("All bulk API tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,200 @@
+/**
+ * @file test_config_manager.c
+ * @brief Unit tests for the running and startup configuration
+ *
+ * The manager keeps its files under ./config, so the tests run in a
+ * directory of their own.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../../include/management/config_manager.h"
+#include "../../include/l2/vlan.h"
+#include "../../include/l3/routing_table.h"
+#include "../../include/hal/port.h"
+#include "../../include/hal/hw_resources.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define NUM_PORTS 8
+#define SAVES 50
+#define STARTUP_FILE "config/startup-config.json"
+#define BACKUP_DIR "config/backups"
+
+static const char g_config[] =
+    "{ \"switch\": { \"name\": \"lab\", \"ports\": { \"enabled\": [1, 2] },"
+    "  \"vlans\": { \"30\": { \"name\": \"lab\", \"ports\": [1], \"tagged\": [2] } },"
+    "  \"routes\": [ { \"prefix\": \"10.0.0.0/8\", \"next_hop\": \"192.168.1.1\", \"interface\": 1 } ] } }";
+
+static routing_table_t g_table;
+
+/* Model of the startup configuration file */
+static void read_startup(config_model_t *model) {
+    config_model_init(model);
+    assert(config_model_load_file(model, STARTUP_FILE, NULL, NULL) == STATUS_SUCCESS);
+}
+
+static void expect_param(const char *key, const char *expected) {
+    char value[128];
+
+    assert(config_manager_get_param(key, value, sizeof(value)) == STATUS_SUCCESS);
+    assert(strcmp(value, expected) == 0);
+}
+
+static int count_files(const char *path) {
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    int count = 0;
+
+    assert(dir != NULL);
+    while ((entry = readdir(dir)) != NULL) {
+        count += entry->d_name[0] != '.';
+    }
+    closedir(dir);
+    return count;
+}
+
+/* Remove the files of a directory, then the directory */
+static void remove_dir(const char *path) {
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    char file[512];
+
+    assert(dir != NULL);
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+            assert(unlink(file) == 0);
+        }
+    }
+    closedir(dir);
+    assert(rmdir(path) == 0);
+}
+
+void test_config_manager_apply() {
+    config_diff_stats_t stats;
+    char value[16];
+
+    // Without a startup file nothing is applied and nothing is pending
+    assert(config_manager_init() == STATUS_SUCCESS);
+    assert(!config_manager_is_modified());
+    assert(access(STARTUP_FILE, F_OK) != 0);
+
+    // A bad configuration is refused as a whole
+    assert(config_manager_apply_json("{ \"switch\": ", 12, &stats) == STATUS_INVALID_PARAMETER);
+    assert(!config_manager_is_modified());
+
+    assert(config_manager_apply_json(g_config, sizeof(g_config) - 1, &stats) == STATUS_SUCCESS);
+    assert(stats.ports_enabled == 2 && stats.vlans_created == 1 && stats.routes_added == 1);
+    assert(config_manager_is_modified());
+    expect_param("switch.vlans.30.tagged", "2");
+
+    // Parameters change the running configuration one at a time
+    assert(config_manager_set_param("switch.vlans.30.ports", "1,3") == STATUS_SUCCESS);
+    expect_param("switch.vlans.30.ports", "1,3");
+    assert(config_manager_set_param("switch.nothing", "1") == STATUS_NOT_FOUND);
+    assert(config_manager_get_param("switch.vlans.40", value, sizeof(value)) == STATUS_NOT_FOUND);
+    assert(config_manager_set_param(NULL, "1") == STATUS_INVALID_PARAMETER);
+
+    printf(TEST_PASSED, "test_config_manager_apply");
+}
+
+void test_config_manager_save() {
+    config_model_t saved;
+    char name[16];
+
+    // A save is written in the background; waiting gives its outcome
+    assert(config_manager_save_startup_config() == STATUS_SUCCESS);
+    assert(config_manager_wait_for_save() == STATUS_SUCCESS);
+    assert(!config_manager_is_modified());
+    read_startup(&saved);
+    assert(strcmp(saved.name, "lab") == 0 && saved.vlan_count == 1 && saved.route_count == 1);
+    assert(count_files(BACKUP_DIR) == 0);
+
+    // Queued saves are coalesced; the last configuration is what is written
+    for (int i = 0; i < SAVES; i++) {
+        snprintf(name, sizeof(name), "lab-%d", i);
+        assert(config_manager_set_param("switch.name", name) == STATUS_SUCCESS);
+        assert(config_manager_save_startup_config() == STATUS_SUCCESS);
+    }
+    assert(config_manager_wait_for_save() == STATUS_SUCCESS);
+    assert(!config_manager_is_modified());
+    config_model_free(&saved);
+    read_startup(&saved);
+    assert(strcmp(saved.name, name) == 0);
+
+    // The file written before is kept as a backup
+    assert(count_files(BACKUP_DIR) >= 1);
+
+    // A change made after the snapshot keeps the configuration modified
+    assert(config_manager_save_startup_config() == STATUS_SUCCESS);
+    assert(config_manager_set_param("switch.name", "changed") == STATUS_SUCCESS);
+    assert(config_manager_wait_for_save() == STATUS_SUCCESS);
+    assert(config_manager_is_modified());
+    config_model_free(&saved);
+    read_startup(&saved);
+    assert(strcmp(saved.name, name) == 0);
+
+    // No temporary file is left next to the startup file
+    assert(access(STARTUP_FILE ".tmp", F_OK) != 0);
+
+    config_model_free(&saved);
+    printf(TEST_PASSED, "test_config_manager_save");
+}
+
+void test_config_manager_restart() {
+    char name[16];
+
+    assert(config_manager_save_startup_config() == STATUS_SUCCESS);
+    assert(config_manager_deinit() == STATUS_SUCCESS);
+    assert(config_manager_save_startup_config() == STATUS_NOT_INITIALIZED);
+    assert(config_manager_wait_for_save() == STATUS_NOT_INITIALIZED);
+    assert(config_manager_get_param("switch.name", name, sizeof(name)) == STATUS_NOT_INITIALIZED);
+
+    // The save queued before shutdown is written, and read back on start
+    assert(config_manager_init() == STATUS_SUCCESS);
+    expect_param("switch.name", "changed");
+    expect_param("switch.vlans.30.ports", "1,3");
+    expect_param("switch.routes.10.0.0.0/8", "192.168.1.1,1,0");
+    assert(!config_manager_is_modified());
+
+    assert(config_manager_deinit() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_config_manager_restart");
+}
+
+int main() {
+    char dir[] = "/tmp/test_config_manager_XXXXXX";
+    char cwd[512];
+
+    printf("Running config manager unit tests...\n");
+
+    assert(getcwd(cwd, sizeof(cwd)) != NULL);
+    assert(mkdtemp(dir) != NULL && chdir(dir) == 0);
+
+    // Applied configurations drive the port, VLAN and routing layers
+    assert(hw_resources_init() == STATUS_SUCCESS);
+    assert(port_init() == STATUS_SUCCESS);
+    assert(vlan_init(NUM_PORTS) == STATUS_SUCCESS);
+    assert(routing_table_init(&g_table) == STATUS_SUCCESS);
+
+    test_config_manager_apply();
+    test_config_manager_save();
+    test_config_manager_restart();
+
+    assert(routing_table_cleanup() == STATUS_SUCCESS);
+    assert(vlan_deinit() == STATUS_SUCCESS);
+
+    remove_dir(BACKUP_DIR);
+    remove_dir("config");
+    assert(chdir(cwd) == 0 && rmdir(dir) == 0);
+
+    printf("All config manager tests completed successfully.\n");
+    return 0;
+}
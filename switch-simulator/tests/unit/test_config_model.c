@@ -0,0 +1,498 @@
+/**
+ * @file test_config_model.c
+ * @brief Unit tests for the configuration model and its incremental apply
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "../../include/management/config_model.h"
+#include "../../include/l2/vlan.h"
+#include "../../include/l3/routing_table.h"
+#include "../../include/hal/port.h"
+#include "../../include/hal/hw_resources.h"
+#include "../../include/common/bitmap.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define NUM_PORTS 8
+#define RENDER_SIZE 4096
+#define MANY_VLANS 4000
+#define MANY_ROUTES 20000
+
+static const char g_config[] =
+    "{\n"
+    "  \"switch\": {\n"
+    "    \"name\": \"SwitchSimulator\",\n"
+    "    \"ports\": { \"enabled\": [1, 2, 3, 4] },\n"
+    "    \"vlans\": {\n"
+    "      \"10\": { \"name\": \"users\", \"ports\": [3, 4], \"tagged\": [4] },\n"
+    "      \"1\":  { \"name\": \"default\", \"ports\": [1, 2] }\n"
+    "    },\n"
+    "    \"routes\": [\n"
+    "      { \"prefix\": \"10.0.0.0/8\", \"next_hop\": \"192.168.1.2\", \"interface\": 2, \"metric\": 1 },\n"
+    "      { \"prefix\": \"10.1.2.3/8\", \"next_hop\": \"192.168.1.1\", \"interface\": 1, \"metric\": 1 },\n"
+    "      { \"prefix\": \"172.16.0.0/12\", \"next_hop\": \"192.168.1.1\", \"interface\": 1 }\n"
+    "    ],\n"
+    "    \"unknown\": { \"kept\": [true, null, -1.5e3] }\n"
+    "  }\n"
+    "}\n";
+
+static routing_table_t g_table;
+
+static void parse(config_model_t *model, const char *json) {
+    config_model_init(model);
+    assert(config_model_parse(model, json, strlen(json)) == STATUS_SUCCESS);
+}
+
+static void expect_param(const config_model_t *model, const char *key, const char *expected) {
+    char value[256];
+
+    assert(config_model_get(model, key, value, sizeof(value)) == STATUS_SUCCESS);
+    assert(strcmp(value, expected) == 0);
+}
+
+/* Rendered text of a model, to compare models by */
+static char *render(const config_model_t *model) {
+    size_t size = RENDER_SIZE;
+    char *text = NULL;
+    status_t status;
+
+    do {
+        size *= 2;
+        text = (char *)realloc(text, size);
+        assert(text != NULL);
+        status = config_model_render(model, text, size, NULL);
+    } while (status == STATUS_RESOURCE_EXCEEDED);
+    assert(status == STATUS_SUCCESS);
+    return text;
+}
+
+static bool same_model(const config_model_t *a, const config_model_t *b) {
+    char *x = render(a);
+    char *y = render(b);
+    bool same = strcmp(x, y) == 0;
+
+    free(x);
+    free(y);
+    return same;
+}
+
+static void write_file(const char *path, const char *text) {
+    FILE *f = fopen(path, "w");
+
+    assert(f != NULL);
+    assert(fwrite(text, 1, strlen(text), f) == strlen(text));
+    assert(fclose(f) == 0);
+}
+
+/* Configuration with enough objects for many parser buffers */
+static char *make_large_config(void) {
+    size_t size = 64 + MANY_VLANS * 64 + MANY_ROUTES * 96;
+    char *text = (char *)malloc(size);
+    size_t len = 0;
+
+    assert(text != NULL);
+    len += (size_t)snprintf(text + len, size - len, "{\"switch\":{\"name\":\"big\",\"vlans\":{");
+    for (int i = 0; i < MANY_VLANS; i++) {
+        len += (size_t)snprintf(text + len, size - len, "%s\"%d\":{\"name\":\"v%d\",\"tagged\":[%d]}",
+                                i ? "," : "", i + 2, i, i % NUM_PORTS);
+    }
+    len += (size_t)snprintf(text + len, size - len, "},\"routes\":[");
+    for (int i = 0; i < MANY_ROUTES; i++) {
+        len += (size_t)snprintf(text + len, size - len,
+                                "%s{\"prefix\":\"10.%d.%d.0/24\",\"next_hop\":\"192.168.1.1\",\"interface\":1}",
+                                i ? "," : "", i / 256, i % 256);
+    }
+    len += (size_t)snprintf(text + len, size - len, "]}}");
+    assert(len < size);
+    return text;
+}
+
+static ip_addr_t v4(const char *text) {
+    ip_addr_t addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.type = IP_TYPE_V4;
+    assert(inet_pton(AF_INET, text, &addr.addr.v4) == 1);
+    return addr;
+}
+
+static bool port_admin_up(port_id_t port) {
+    port_config_t config;
+
+    assert(port_get_config(port, &config) == STATUS_SUCCESS);
+    return config.admin_state;
+}
+
+void test_config_model_parse() {
+    config_model_t model;
+
+    parse(&model, g_config);
+
+    // Objects come out sorted, with host bits cleared and unknown keys skipped
+    assert(strcmp(model.name, "SwitchSimulator") == 0);
+    assert(bitmap_count(model.enabled_ports.w, VLAN_PORT_WORDS) == 4);
+    assert(model.vlan_count == 2);
+    assert(model.vlans[0].vlan_id == 1 && strcmp(model.vlans[0].name, "default") == 0);
+    assert(model.vlans[1].vlan_id == 10 && strcmp(model.vlans[1].name, "users") == 0);
+    assert(model.route_count == 3);
+    assert(model.routes[0].prefix_len == 8 && model.routes[0].source == ROUTE_TYPE_STATIC);
+
+    // A port listed both ways is a tagged member
+    assert(bitmap_test(model.vlans[1].untagged.w, 3) && !bitmap_test(model.vlans[1].untagged.w, 4));
+    assert(bitmap_test(model.vlans[1].tagged.w, 4));
+
+    // Paths of one prefix are ordered by next hop
+    expect_param(&model, "switch.routes.10.0.0.0/8", "192.168.1.1,1,1;192.168.1.2,2,1");
+    expect_param(&model, "switch.routes.172.16.0.0/12", "192.168.1.1,1,0");
+
+    // A bad configuration leaves the model as it was
+    assert(config_model_parse(&model, "{ \"switch\": { \"name\": ", 21) == STATUS_INVALID_PARAMETER);
+    assert(config_model_parse(&model, "{ \"other\": {} }", 15) == STATUS_INVALID_PARAMETER);
+    assert(config_model_parse(&model, "{ \"switch\": {} } x", 18) == STATUS_INVALID_PARAMETER);
+    const char *twice = "{ \"switch\": { \"vlans\": { \"5\": {}, \"5\": {} } } }";
+    assert(config_model_parse(&model, twice, strlen(twice)) == STATUS_INVALID_PARAMETER);
+    const char *range = "{ \"switch\": { \"vlans\": { \"4095\": {} } } }";
+    assert(config_model_parse(&model, range, strlen(range)) == STATUS_INVALID_PARAMETER);
+    const char *route = "{ \"switch\": { \"routes\": [ { \"prefix\": \"10.0.0.0/33\" } ] } }";
+    assert(config_model_parse(&model, route, strlen(route)) == STATUS_INVALID_PARAMETER);
+    assert(model.vlan_count == 2 && model.route_count == 3);
+    assert(config_model_parse(NULL, g_config, sizeof(g_config) - 1) == STATUS_INVALID_PARAMETER);
+
+    // The text need not be terminated
+    assert(config_model_parse(&model, "{ \"switch\": {} }x", 16) == STATUS_SUCCESS);
+    assert(model.vlan_count == 0 && model.route_count == 0 && model.name[0] == '\0');
+
+    config_model_free(&model);
+    config_model_free(NULL);
+    printf(TEST_PASSED, "test_config_model_parse");
+}
+
+void test_config_model_params() {
+    config_model_t model;
+    char value[8];
+
+    parse(&model, g_config);
+
+    assert(config_model_set(&model, "switch.name", "core-1") == STATUS_SUCCESS);
+    expect_param(&model, "switch.name", "core-1");
+    assert(config_model_set(&model, "switch.ports.enabled", "5,1") == STATUS_SUCCESS);
+    expect_param(&model, "switch.ports.enabled", "1,5");
+
+    // Setting a field of a VLAN creates it in order
+    assert(config_model_set(&model, "switch.vlans.5.ports", "1,2") == STATUS_SUCCESS);
+    assert(model.vlan_count == 3 && model.vlans[1].vlan_id == 5);
+    expect_param(&model, "switch.vlans.5.name", "");
+    assert(config_model_set(&model, "switch.vlans.5", "servers") == STATUS_SUCCESS);
+    expect_param(&model, "switch.vlans.5", "servers");
+
+    // Untagged and tagged take ports from each other
+    assert(config_model_set(&model, "switch.vlans.5.tagged", "2,3") == STATUS_SUCCESS);
+    expect_param(&model, "switch.vlans.5.ports", "1");
+    assert(config_model_set(&model, "switch.vlans.5.ports", "1,3") == STATUS_SUCCESS);
+    expect_param(&model, "switch.vlans.5.tagged", "2");
+
+    // An empty name deletes the VLAN
+    assert(config_model_set(&model, "switch.vlans.5", "") == STATUS_SUCCESS);
+    assert(model.vlan_count == 2);
+    assert(config_model_get(&model, "switch.vlans.5", value, sizeof(value)) == STATUS_NOT_FOUND);
+
+    // Routes are replaced a prefix at a time
+    assert(config_model_set(&model, "switch.routes.10.0.0.0/8", "192.168.1.3,3,2") == STATUS_SUCCESS);
+    assert(model.route_count == 2);
+    expect_param(&model, "switch.routes.10.0.0.0/8", "192.168.1.3,3,2");
+    assert(config_model_set(&model, "switch.routes.2001:db8::/32", "fe80::1,1;fe80::2") == STATUS_SUCCESS);
+    expect_param(&model, "switch.routes.2001:db8::/32", "fe80::1,1,0;fe80::2,0,0");
+    assert(config_model_set(&model, "switch.routes.10.0.0.0/8", "") == STATUS_SUCCESS);
+    assert(config_model_get(&model, "switch.routes.10.0.0.0/8", value, sizeof(value)) == STATUS_NOT_FOUND);
+    assert(model.route_count == 3);
+
+    // Bad values change nothing
+    assert(config_model_set(&model, "switch.ports.enabled", "1,x") == STATUS_INVALID_PARAMETER);
+    assert(config_model_set(&model, "switch.vlans.10.ports", "1,,2") == STATUS_INVALID_PARAMETER);
+    assert(config_model_set(&model, "switch.routes.10.0.0.0/8", "1.1.1.1;1.1.1.1") == STATUS_INVALID_PARAMETER);
+    assert(config_model_set(&model, "switch.routes.10.0.0.0/8", "fe80::1") == STATUS_INVALID_PARAMETER);
+    assert(config_model_set(&model, "switch.vlans.10.name", "a name longer than thirty-two bytes") ==
+           STATUS_INVALID_PARAMETER);
+    expect_param(&model, "switch.ports.enabled", "1,5");
+    expect_param(&model, "switch.vlans.10.ports", "3");
+    assert(model.route_count == 3);
+
+    assert(config_model_set(&model, "switch.other", "1") == STATUS_NOT_FOUND);
+    assert(config_model_set(&model, "switch.vlans.4095.name", "x") == STATUS_NOT_FOUND);
+    assert(config_model_set(&model, "switch.vlans.10.mtu", "1500") == STATUS_NOT_FOUND);
+    assert(config_model_get(&model, "switch.routes.bad", value, sizeof(value)) == STATUS_NOT_FOUND);
+    assert(config_model_get(&model, "switch.name", value, 4) == STATUS_RESOURCE_EXCEEDED);
+
+    config_model_free(&model);
+    printf(TEST_PASSED, "test_config_model_params");
+}
+
+void test_config_model_render() {
+    config_model_t model;
+    config_model_t reread;
+    config_model_t copy;
+    char *first = (char *)malloc(RENDER_SIZE);
+    char *second = (char *)malloc(RENDER_SIZE);
+    size_t first_len;
+    size_t second_len;
+
+    assert(first && second);
+    parse(&model, g_config);
+    assert(config_model_set(&model, "switch.name", "quote \" and \\ slash") == STATUS_SUCCESS);
+
+    // What is written reads back as the same model
+    assert(config_model_render(&model, first, RENDER_SIZE, &first_len) == STATUS_SUCCESS);
+    assert(first_len == strlen(first));
+    parse(&reread, first);
+    assert(strcmp(reread.name, model.name) == 0);
+    assert(reread.vlan_count == model.vlan_count && reread.route_count == model.route_count);
+    assert(memcmp(reread.vlans, model.vlans, model.vlan_count * sizeof(config_vlan_t)) == 0);
+    assert(config_model_render(&reread, second, RENDER_SIZE, &second_len) == STATUS_SUCCESS);
+    assert(second_len == first_len && strcmp(first, second) == 0);
+
+    // A copy owns its arrays
+    assert(config_model_copy(&copy, &model) == STATUS_SUCCESS);
+    assert(copy.vlans != model.vlans && copy.routes != model.routes);
+    config_model_free(&model);
+    assert(config_model_render(&copy, second, RENDER_SIZE, NULL) == STATUS_SUCCESS);
+    assert(strcmp(first, second) == 0);
+
+    // An empty model renders too; a short buffer is refused
+    config_model_init(&model);
+    assert(config_model_render(&model, second, RENDER_SIZE, &second_len) == STATUS_SUCCESS);
+    assert(strstr(second, "\"vlans\": {}") != NULL && strstr(second, "\"routes\": []") != NULL);
+    assert(config_model_render(&copy, second, first_len, NULL) == STATUS_RESOURCE_EXCEEDED);
+    assert(config_model_render(&copy, second, first_len + 1, NULL) == STATUS_SUCCESS);
+
+    config_model_free(&copy);
+    config_model_free(&reread);
+    free(first);
+    free(second);
+    printf(TEST_PASSED, "test_config_model_render");
+}
+
+void test_config_model_stream() {
+    config_model_t whole;
+    config_model_t pieces;
+    config_stream_t *stream;
+    char *large = make_large_config();
+    size_t large_len = strlen(large);
+    char long_name[300];
+
+    parse(&whole, g_config);
+
+    // Text fed a byte at a time reads as the same model
+    config_model_init(&pieces);
+    stream = config_stream_create();
+    assert(stream != NULL);
+    for (size_t i = 0; i < sizeof(g_config) - 1; i++) {
+        assert(config_stream_feed(stream, &g_config[i], 1) == STATUS_SUCCESS);
+    }
+    assert(config_stream_finish(stream, &pieces) == STATUS_SUCCESS);
+    config_stream_destroy(stream);
+    assert(same_model(&whole, &pieces));
+
+    // So does a large configuration cut at odd places
+    assert(config_model_parse(&whole, large, large_len) == STATUS_SUCCESS);
+    assert(whole.vlan_count == MANY_VLANS && whole.route_count == MANY_ROUTES);
+    stream = config_stream_create();
+    for (size_t i = 0; i < large_len; i += 7) {
+        size_t n = large_len - i < 7 ? large_len - i : 7;
+        assert(config_stream_feed(stream, large + i, n) == STATUS_SUCCESS);
+    }
+    assert(config_stream_finish(stream, &pieces) == STATUS_SUCCESS);
+    config_stream_destroy(stream);
+    assert(same_model(&whole, &pieces));
+    // Escapes are decoded; members after "switch" are skipped
+    // A number may end the text; escapes are decoded
+    const char *escaped = "{ \"switch\": { \"name\": \"a\\u0042\\n\\\"\" }, \"version\": 2 }";
+    assert(config_model_parse(&pieces, escaped, strlen(escaped)) == STATUS_SUCCESS);
+    assert(strcmp(pieces.name, "aB\n\"") == 0);
+
+    // The first error sticks, and the model is left alone
+    stream = config_stream_create();
+    assert(config_stream_feed(stream, "{ \"switch\": [", 13) == STATUS_INVALID_PARAMETER);
+    assert(config_stream_feed(stream, "] }", 3) == STATUS_INVALID_PARAMETER);
+    assert(config_stream_finish(stream, &pieces) == STATUS_INVALID_PARAMETER);
+    config_stream_destroy(stream);
+    assert(strcmp(pieces.name, "aB\n\"") == 0);
+
+    // Tokens and nesting are bounded
+    memset(long_name, 'x', sizeof(long_name));
+    memcpy(long_name, "{\"a\":\"", 6);
+    stream = config_stream_create();
+    assert(config_stream_feed(stream, long_name, sizeof(long_name)) == STATUS_INVALID_PARAMETER);
+    config_stream_destroy(stream);
+    memset(long_name, '[', sizeof(long_name));
+    long_name[0] = '{';
+    memcpy(long_name + 1, "\"a\":", 4);
+    stream = config_stream_create();
+    assert(config_stream_feed(stream, long_name, sizeof(long_name)) == STATUS_INVALID_PARAMETER);
+    config_stream_destroy(stream);
+    config_stream_destroy(NULL);
+
+    config_model_free(&whole);
+    config_model_free(&pieces);
+    free(large);
+    printf(TEST_PASSED, "test_config_model_stream");
+}
+
+void test_config_model_cache() {
+    char path[] = "/tmp/test_config_model_XXXXXX";
+    char cache_path[sizeof(path) + 8];
+    config_model_t parsed;
+    config_model_t loaded;
+    char *large = make_large_config();
+    bool cached = true;
+    int fd = mkstemp(path);
+
+    assert(fd >= 0);
+    close(fd);
+    snprintf(cache_path, sizeof(cache_path), "%s.cache", path);
+    write_file(path, g_config);
+    parse(&parsed, g_config);
+
+    // The first load parses and compiles, the next reads the compiled copy
+    config_model_init(&loaded);
+    assert(config_model_load_file(&loaded, path, cache_path, &cached) == STATUS_SUCCESS);
+    assert(!cached && same_model(&parsed, &loaded));
+    assert(access(cache_path, F_OK) == 0);
+    config_model_free(&loaded);
+    assert(config_model_load_file(&loaded, path, cache_path, &cached) == STATUS_SUCCESS);
+    assert(cached && same_model(&parsed, &loaded));
+
+    // Without a cache path the file is always parsed
+    assert(config_model_load_file(&loaded, path, NULL, &cached) == STATUS_SUCCESS);
+    assert(!cached && same_model(&parsed, &loaded));
+
+    // A file that changed is parsed again, and compiled again
+    write_file(path, large);
+    assert(config_model_parse(&parsed, large, strlen(large)) == STATUS_SUCCESS);
+    assert(config_model_load_file(&loaded, path, cache_path, &cached) == STATUS_SUCCESS);
+    assert(!cached && same_model(&parsed, &loaded));
+    assert(config_model_load_file(&loaded, path, cache_path, NULL) == STATUS_SUCCESS);
+    assert(same_model(&parsed, &loaded));
+    assert(config_model_load_file(&loaded, path, cache_path, &cached) == STATUS_SUCCESS && cached);
+
+    // A damaged compiled copy is ignored
+    assert(truncate(cache_path, 100) == 0);
+    assert(config_model_load_file(&loaded, path, cache_path, &cached) == STATUS_SUCCESS);
+    assert(!cached && same_model(&parsed, &loaded));
+
+    // A bad file leaves the model as it was
+    write_file(path, "{ \"switch\": ");
+    assert(config_model_load_file(&loaded, path, cache_path, &cached) == STATUS_INVALID_PARAMETER);
+    assert(loaded.route_count == MANY_ROUTES);
+
+    unlink(path);
+    unlink(cache_path);
+    assert(config_model_load_file(&loaded, path, cache_path, &cached) == STATUS_NOT_FOUND);
+    assert(config_model_write_cache(&loaded, path, cache_path) == STATUS_NOT_FOUND);
+    assert(access(cache_path, F_OK) != 0);
+
+    config_model_free(&parsed);
+    config_model_free(&loaded);
+    free(large);
+    printf(TEST_PASSED, "test_config_model_cache");
+}
+
+void test_config_model_apply() {
+    config_model_t running;
+    config_model_t target;
+    config_diff_stats_t stats;
+    vlan_port_bitmap_t members;
+    vlan_port_bitmap_t untagged;
+    vlan_entry_t entry;
+    route_entry_t route;
+    ip_addr_t dest = v4("10.9.9.9");
+
+    // The first apply starts from nothing and makes every object
+    config_model_init(&running);
+    parse(&target, g_config);
+    assert(config_model_apply(&running, &target, &stats) == STATUS_SUCCESS);
+    assert(stats.failed == 0);
+    assert(stats.ports_enabled == 4 && stats.ports_disabled == 0);
+    assert(stats.vlans_created == 2 && stats.vlans_deleted == 0);
+    assert(stats.members_added == 4 && stats.members_removed == 0);
+    assert(stats.routes_added == 3 && stats.routes_removed == 0);
+
+    for (port_id_t port = 1; port <= 4; port++) {
+        assert(port_admin_up(port));
+    }
+    assert(vlan_get(VLAN_ID_DEFAULT, &entry) == STATUS_SUCCESS && strcmp(entry.name, "default") == 0);
+    assert(vlan_get_member_bitmaps(10, &members, &untagged) == STATUS_SUCCESS);
+    assert(bitmap_test(members.w, 3) && bitmap_test(untagged.w, 3));
+    assert(bitmap_test(members.w, 4) && !bitmap_test(untagged.w, 4));
+    assert(routing_lookup(&dest, IP_TYPE_V4, &route) == STATUS_SUCCESS);
+
+    // The same configuration again changes nothing
+    config_model_free(&running);
+    assert(config_model_copy(&running, &target) == STATUS_SUCCESS);
+    assert(config_model_apply(&running, &target, &stats) == STATUS_SUCCESS);
+    assert(stats.ports_enabled == 0 && stats.vlans_created == 0 && stats.vlans_renamed == 0);
+    assert(stats.members_added == 0 && stats.members_removed == 0);
+    assert(stats.routes_added == 0 && stats.routes_removed == 0 && stats.failed == 0);
+
+    // Only what differs is changed
+    assert(config_model_set(&target, "switch.ports.enabled", "1,2,3,5") == STATUS_SUCCESS);
+    assert(config_model_set(&target, "switch.vlans.10.name", "staff") == STATUS_SUCCESS);
+    assert(config_model_set(&target, "switch.vlans.10.tagged", "") == STATUS_SUCCESS);
+    assert(config_model_set(&target, "switch.vlans.20.tagged", "5") == STATUS_SUCCESS);
+    assert(config_model_set(&target, "switch.routes.10.0.0.0/8", "") == STATUS_SUCCESS);
+    assert(config_model_set(&target, "switch.routes.172.16.0.0/12", "192.168.1.1,1,5") == STATUS_SUCCESS);
+    assert(config_model_apply(&running, &target, &stats) == STATUS_SUCCESS);
+    assert(stats.ports_enabled == 1 && stats.ports_disabled == 1);
+    assert(stats.vlans_created == 1 && stats.vlans_renamed == 1 && stats.vlans_deleted == 0);
+    assert(stats.members_added == 1 && stats.members_removed == 1);
+    assert(stats.routes_removed == 3 && stats.routes_added == 1 && stats.failed == 0);
+
+    assert(!port_admin_up(4) && port_admin_up(5));
+    assert(vlan_get(10, &entry) == STATUS_SUCCESS && strcmp(entry.name, "staff") == 0);
+    assert(vlan_get_member_bitmaps(10, &members, NULL) == STATUS_SUCCESS && !bitmap_test(members.w, 4));
+    assert(vlan_get_member_bitmaps(20, &members, NULL) == STATUS_SUCCESS && bitmap_test(members.w, 5));
+    assert(routing_lookup(&dest, IP_TYPE_V4, &route) == STATUS_NOT_FOUND);
+
+    // A VLAN that leaves the configuration is deleted
+    config_model_free(&running);
+    assert(config_model_copy(&running, &target) == STATUS_SUCCESS);
+    assert(config_model_set(&target, "switch.vlans.20", "") == STATUS_SUCCESS);
+    assert(config_model_apply(&running, &target, NULL) == STATUS_SUCCESS);
+    assert(vlan_get(20, &entry) != STATUS_SUCCESS);
+
+    assert(config_model_apply(NULL, &target, &stats) == STATUS_INVALID_PARAMETER);
+
+    config_model_free(&running);
+    config_model_free(&target);
+    printf(TEST_PASSED, "test_config_model_apply");
+}
+
+int main() {
+    printf("Running configuration model unit tests...\n");
+
+    test_config_model_parse();
+    test_config_model_params();
+    test_config_model_render();
+    test_config_model_stream();
+    test_config_model_cache();
+
+    // An apply drives the port, VLAN and routing layers
+    assert(hw_resources_init() == STATUS_SUCCESS);
+    assert(port_init() == STATUS_SUCCESS);
+    assert(vlan_init(NUM_PORTS) == STATUS_SUCCESS);
+    assert(routing_table_init(&g_table) == STATUS_SUCCESS);
+
+    test_config_model_apply();
+
+    assert(routing_table_cleanup() == STATUS_SUCCESS);
+    assert(vlan_deinit() == STATUS_SUCCESS);
+
+    printf("All configuration model tests completed successfully.\n");
+    return 0;
+}
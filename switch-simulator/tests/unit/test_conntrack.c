@@ -0,0 +1,441 @@
+/**
+ * @file test_conntrack.c
+ * @brief Unit tests for connection tracking and NAT
+ *
+ * Packets go through the pipeline off the forwarding workers, so they
+ * share one table and every reply is seen where its connection lives. The
+ * clock is virtual, so that timeouts of minutes pass at once. Every
+ * translated packet must still carry valid IP and L4 checksums.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <arpa/inet.h>
+#include "../../include/l3/conntrack.h"
+#include "../../include/l3/ip.h"
+#include "../../include/hal/packet.h"
+#include "../../include/hal/port.h"
+#include "../../include/common/sim_clock.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define ETH_HDR_LEN 14
+#define IP_HDR_LEN 20
+#define TCP_HDR_LEN 20
+#define UDP_HDR_LEN 8
+#define PAYLOAD_LEN 12
+#define PORT 1
+#define SECOND 1000000ULL
+
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_ACK 0x10
+
+static mac_addr_t g_router_mac;
+
+static ipv4_addr_t ip4(const char *text) {
+    ipv4_addr_t addr;
+
+    assert(inet_pton(AF_INET, text, &addr) == 1);
+    return addr;
+}
+
+/* Ones' complement sum of big-endian words */
+static uint32_t sum16(uint32_t sum, const uint8_t *data, uint32_t len) {
+    for (uint32_t i = 0; i + 1 < len; i += 2) {
+        sum += (uint32_t)data[i] << 8 | data[i + 1];
+    }
+    if (len & 1) {
+        sum += (uint32_t)data[len - 1] << 8;
+    }
+    return sum;
+}
+
+static uint16_t fold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+/* Pseudo-header sum of TCP and UDP; ICMP has none */
+static uint32_t l4_sum(const uint8_t *ip, uint32_t l4_len) {
+    uint32_t sum = sum16(0, ip + 12, 8) + ip[9] + l4_len;
+
+    return ip[9] == IP_PROTO_ICMP ? 0 : sum;
+}
+
+/* Whether both checksums of a packet verify */
+static bool checksums_ok(const packet_buffer_t *pkt) {
+    const uint8_t *ip = pkt->data + ETH_HDR_LEN;
+    uint32_t l4_len = pkt->length - ETH_HDR_LEN - IP_HDR_LEN;
+
+    return fold(sum16(0, ip, IP_HDR_LEN)) == 0xFFFF &&
+           fold(sum16(l4_sum(ip, l4_len), ip + IP_HDR_LEN, l4_len)) == 0xFFFF;
+}
+
+/* A routed IPv4 packet with valid checksums; for ICMP, sport is the echo identifier */
+static packet_buffer_t *make_ip(uint8_t protocol, const char *src, const char *dst, uint16_t sport,
+                                uint16_t dport, uint8_t flags) {
+    uint8_t frame[ETH_HDR_LEN + IP_HDR_LEN + TCP_HDR_LEN + PAYLOAD_LEN] = {0};
+    uint8_t *ip = frame + ETH_HDR_LEN;
+    uint8_t *l4 = ip + IP_HDR_LEN;
+    uint32_t l4_len = (protocol == IP_PROTO_TCP ? TCP_HDR_LEN : UDP_HDR_LEN) + PAYLOAD_LEN;
+    uint32_t len = ETH_HDR_LEN + IP_HDR_LEN + l4_len;
+    ipv4_addr_t saddr = ip4(src), daddr = ip4(dst);
+    uint16_t csum;
+    packet_buffer_t *pkt = packet_buffer_alloc(sizeof(frame));
+
+    memcpy(frame, g_router_mac.addr, 6);
+    memset(frame + 6, 0x02, 6);
+    frame[12] = 0x08;
+    ip[0] = 0x45;
+    ip[2] = (uint8_t)((IP_HDR_LEN + l4_len) >> 8);
+    ip[3] = (uint8_t)(IP_HDR_LEN + l4_len);
+    ip[8] = 64;
+    ip[9] = protocol;
+    memcpy(ip + 12, &saddr, 4);
+    memcpy(ip + 16, &daddr, 4);
+    csum = (uint16_t)~fold(sum16(0, ip, IP_HDR_LEN));
+    ip[10] = (uint8_t)(csum >> 8);
+    ip[11] = (uint8_t)csum;
+
+    for (uint32_t i = 0; i < PAYLOAD_LEN; i++) {
+        l4[l4_len - PAYLOAD_LEN + i] = (uint8_t)(0x30 + i);
+    }
+    if (protocol == IP_PROTO_ICMP) {
+        l4[0] = flags;
+        l4[4] = (uint8_t)(sport >> 8);
+        l4[5] = (uint8_t)sport;
+    } else {
+        l4[0] = (uint8_t)(sport >> 8);
+        l4[1] = (uint8_t)sport;
+        l4[2] = (uint8_t)(dport >> 8);
+        l4[3] = (uint8_t)dport;
+        if (protocol == IP_PROTO_TCP) {
+            l4[12] = 0x50;
+            l4[13] = flags;
+        } else {
+            l4[4] = (uint8_t)(l4_len >> 8);
+            l4[5] = (uint8_t)l4_len;
+        }
+    }
+    csum = (uint16_t)~fold(sum16(l4_sum(ip, l4_len), l4, l4_len));
+    l4[protocol == IP_PROTO_TCP ? 16 : protocol == IP_PROTO_UDP ? 6 : 2] = (uint8_t)(csum >> 8);
+    l4[protocol == IP_PROTO_TCP ? 17 : protocol == IP_PROTO_UDP ? 7 : 3] = (uint8_t)csum;
+
+    assert(pkt != NULL);
+    assert(packet_append_data(pkt, frame, len) == STATUS_SUCCESS);
+    pkt->metadata.port = PORT;
+    return pkt;
+}
+
+/* Run one packet through the pipeline */
+static packet_result_t process(packet_buffer_t *pkt) {
+    packet_result_t result;
+
+    assert(packet_process_burst(&pkt, 1, &result) == STATUS_SUCCESS);
+    return result;
+}
+
+/* Run a packet through and free it */
+static packet_result_t send_one(uint8_t protocol, const char *src, const char *dst, uint16_t sport,
+                                uint16_t dport, uint8_t flags) {
+    packet_buffer_t *pkt = make_ip(protocol, src, dst, sport, dport, flags);
+    packet_result_t result = process(pkt);
+
+    packet_buffer_free(pkt);
+    return result;
+}
+
+/* Whether a packet's addresses and ports are these */
+static bool has_tuple(const packet_buffer_t *pkt, const char *src, const char *dst, uint16_t sport,
+                      uint16_t dport) {
+    const uint8_t *ip = pkt->data + ETH_HDR_LEN;
+    const uint8_t *l4 = ip + IP_HDR_LEN;
+    ipv4_addr_t saddr = ip4(src), daddr = ip4(dst);
+
+    if (memcmp(ip + 12, &saddr, 4) != 0 || memcmp(ip + 16, &daddr, 4) != 0) {
+        return false;
+    }
+    if (ip[9] == IP_PROTO_ICMP) {
+        return (uint16_t)(l4[4] << 8 | l4[5]) == sport;
+    }
+    return (uint16_t)(l4[0] << 8 | l4[1]) == sport && (uint16_t)(l4[2] << 8 | l4[3]) == dport;
+}
+
+static uint16_t src_port_of(const packet_buffer_t *pkt) {
+    const uint8_t *l4 = pkt->data + ETH_HDR_LEN + IP_HDR_LEN;
+
+    return (uint16_t)(l4[0] << 8 | l4[1]);
+}
+
+static conntrack_stats_t stats_now(void) {
+    conntrack_stats_t stats;
+
+    assert(conntrack_get_stats(&stats) == STATUS_SUCCESS);
+    return stats;
+}
+
+void test_conntrack_config() {
+    conntrack_nat_rule_t rule = { .type = CONNTRACK_NAT_SNAT, .match_addr = ip4("192.168.1.0"),
+                                  .match_prefix_len = 24, .nat_addr_min = ip4("203.0.113.1"),
+                                  .nat_addr_max = ip4("203.0.113.1") };
+    conntrack_nat_rule_t bad;
+    conntrack_stats_t stats;
+
+    assert(conntrack_set_enabled(true) == STATUS_NOT_INITIALIZED);
+    assert(conntrack_add_nat_rule(&rule) == STATUS_NOT_INITIALIZED);
+    assert(conntrack_flush() == STATUS_NOT_INITIALIZED);
+    assert(conntrack_get_stats(&stats) == STATUS_NOT_INITIALIZED);
+    assert(conntrack_init() == STATUS_SUCCESS);
+    assert(conntrack_init() == STATUS_ALREADY_INITIALIZED);
+
+    // Rules that could not translate anything
+    assert(conntrack_add_nat_rule(NULL) == STATUS_INVALID_PARAMETER);
+    bad = rule;
+    bad.protocol = 47;
+    assert(conntrack_add_nat_rule(&bad) == STATUS_INVALID_PARAMETER);
+    bad = rule;
+    bad.match_prefix_len = 33;
+    assert(conntrack_add_nat_rule(&bad) == STATUS_INVALID_PARAMETER);
+    bad = rule;
+    bad.nat_addr_min = 0;
+    assert(conntrack_add_nat_rule(&bad) == STATUS_INVALID_PARAMETER);
+    bad = rule;
+    bad.nat_addr_max = ip4("203.0.112.255");
+    assert(conntrack_add_nat_rule(&bad) == STATUS_INVALID_PARAMETER);
+    bad = rule;
+    bad.nat_port_min = 2000;
+    bad.nat_port_max = 1999;
+    assert(conntrack_add_nat_rule(&bad) == STATUS_INVALID_PARAMETER);
+    bad.nat_port_min = 0;
+    assert(conntrack_add_nat_rule(&bad) == STATUS_INVALID_PARAMETER);
+    assert(conntrack_get_stats(NULL) == STATUS_INVALID_PARAMETER);
+
+    // Nothing is tracked until enabled
+    assert(send_one(IP_PROTO_UDP, "192.168.1.10", "8.8.8.8", 5000, 53, 0) == PACKET_RESULT_FORWARD);
+    stats = stats_now();
+    assert(stats.created == 0 && stats.flows == 0 && stats.untracked == 0);
+    assert(conntrack_set_enabled(true) == STATUS_SUCCESS);
+
+    printf(TEST_PASSED, "test_conntrack_config");
+}
+
+void test_conntrack_tracking() {
+    conntrack_stats_t before = stats_now(), stats;
+    packet_buffer_t *pkt;
+
+    // Both directions of a connection are one connection
+    assert(send_one(IP_PROTO_UDP, "10.1.0.1", "10.2.0.1", 4000, 53, 0) == PACKET_RESULT_FORWARD);
+    assert(send_one(IP_PROTO_UDP, "10.1.0.1", "10.2.0.1", 4000, 53, 0) == PACKET_RESULT_FORWARD);
+    assert(send_one(IP_PROTO_UDP, "10.2.0.1", "10.1.0.1", 53, 4000, 0) == PACKET_RESULT_FORWARD);
+    assert(send_one(IP_PROTO_TCP, "10.1.0.1", "10.2.0.1", 4000, 80, TCP_SYN) == PACKET_RESULT_FORWARD);
+    assert(send_one(IP_PROTO_ICMP, "10.1.0.1", "10.2.0.1", 7, 0, 8) == PACKET_RESULT_FORWARD);
+    assert(send_one(IP_PROTO_ICMP, "10.2.0.1", "10.1.0.1", 7, 0, 0) == PACKET_RESULT_FORWARD);
+    stats = stats_now();
+    assert(stats.created == before.created + 3 && stats.flows == before.flows + 3);
+    assert(stats.translated == before.translated);
+
+    // ICMP errors and multicast are routed but not tracked
+    assert(send_one(IP_PROTO_ICMP, "10.2.0.1", "10.1.0.1", 0, 0, 3) == PACKET_RESULT_FORWARD);
+    assert(send_one(IP_PROTO_UDP, "10.1.0.1", "239.1.1.1", 4000, 5000, 0) == PACKET_RESULT_FORWARD);
+    stats = stats_now();
+    assert(stats.untracked == before.untracked + 2 && stats.created == before.created + 3);
+
+    // Frames not sent to the router MAC are not routed here at all
+    pkt = make_ip(IP_PROTO_UDP, "10.1.0.9", "10.2.0.9", 4000, 53, 0);
+    pkt->data[0] ^= 0x02;
+    assert(process(pkt) == PACKET_RESULT_FORWARD);
+    packet_buffer_free(pkt);
+    stats = stats_now();
+    assert(stats.untracked == before.untracked + 2 && stats.created == before.created + 3);
+
+    printf(TEST_PASSED, "test_conntrack_tracking");
+}
+
+void test_conntrack_expiry() {
+    conntrack_stats_t before = stats_now(), stats;
+
+    // An unanswered datagram is forgotten sooner than an answered one
+    assert(send_one(IP_PROTO_UDP, "10.3.0.1", "10.4.0.1", 6000, 123, 0) == PACKET_RESULT_FORWARD);
+    assert(send_one(IP_PROTO_UDP, "10.3.0.2", "10.4.0.1", 6000, 123, 0) == PACKET_RESULT_FORWARD);
+    assert(send_one(IP_PROTO_UDP, "10.4.0.1", "10.3.0.2", 123, 6000, 0) == PACKET_RESULT_FORWARD);
+
+    // A TCP handshake, then a reset
+    assert(send_one(IP_PROTO_TCP, "10.3.0.1", "10.4.0.1", 6001, 22, TCP_SYN) == PACKET_RESULT_FORWARD);
+    assert(send_one(IP_PROTO_TCP, "10.4.0.1", "10.3.0.1", 22, 6001, TCP_SYN | TCP_ACK) == PACKET_RESULT_FORWARD);
+    assert(send_one(IP_PROTO_TCP, "10.3.0.1", "10.4.0.1", 6001, 22, TCP_RST) == PACKET_RESULT_FORWARD);
+    assert(stats_now().flows == before.flows + 3);
+
+    // Connections expire from the stage as packets pass
+    assert(sim_clock_advance_us((CONNTRACK_TCP_CLOSED_TIMEOUT + 1) * SECOND) == STATUS_SUCCESS);
+    assert(send_one(IP_PROTO_UDP, "10.3.0.2", "10.4.0.1", 6000, 123, 0) == PACKET_RESULT_FORWARD);
+    stats = stats_now();
+    assert(stats.expired == before.expired + 1 && stats.flows == before.flows + 2);
+
+    assert(sim_clock_advance_us(CONNTRACK_UDP_UNREPLIED_TIMEOUT * SECOND) == STATUS_SUCCESS);
+    assert(send_one(IP_PROTO_UDP, "10.3.0.2", "10.4.0.1", 6000, 123, 0) == PACKET_RESULT_FORWARD);
+    stats = stats_now();
+    assert(stats.expired == before.expired + 2 && stats.flows == before.flows + 1);
+
+    // Everything else goes quiet past the longest idle timeout
+    assert(sim_clock_advance_us((CONNTRACK_TCP_ESTABLISHED_TIMEOUT + 1) * SECOND) == STATUS_SUCCESS);
+    assert(send_one(IP_PROTO_ICMP, "10.9.0.1", "10.9.0.2", 1, 0, 8) == PACKET_RESULT_FORWARD);
+    assert(stats_now().flows == 1);
+
+    printf(TEST_PASSED, "test_conntrack_expiry");
+}
+
+void test_conntrack_snat() {
+    conntrack_nat_rule_t rule = { .type = CONNTRACK_NAT_SNAT, .match_addr = ip4("192.168.1.0"),
+                                  .match_prefix_len = 24, .nat_addr_min = ip4("203.0.113.1"),
+                                  .nat_addr_max = ip4("203.0.113.1") };
+    conntrack_stats_t before = stats_now(), stats;
+    packet_buffer_t *pkt;
+    uint16_t port;
+
+    assert(conntrack_add_nat_rule(&rule) == STATUS_SUCCESS);
+
+    // The original port is kept where it is free
+    pkt = make_ip(IP_PROTO_UDP, "192.168.1.10", "8.8.8.8", 5000, 53, 0);
+    assert(process(pkt) == PACKET_RESULT_FORWARD);
+    assert(has_tuple(pkt, "203.0.113.1", "8.8.8.8", 5000, 53) && checksums_ok(pkt));
+    packet_buffer_free(pkt);
+    pkt = make_ip(IP_PROTO_UDP, "8.8.8.8", "203.0.113.1", 53, 5000, 0);
+    assert(process(pkt) == PACKET_RESULT_FORWARD);
+    assert(has_tuple(pkt, "8.8.8.8", "192.168.1.10", 53, 5000) && checksums_ok(pkt));
+    packet_buffer_free(pkt);
+
+    // Another host with the same port gets another one
+    pkt = make_ip(IP_PROTO_UDP, "192.168.1.11", "8.8.8.8", 5000, 53, 0);
+    assert(process(pkt) == PACKET_RESULT_FORWARD);
+    port = src_port_of(pkt);
+    assert(port != 5000 && port >= 1024 && has_tuple(pkt, "203.0.113.1", "8.8.8.8", port, 53));
+    assert(checksums_ok(pkt));
+    packet_buffer_free(pkt);
+    pkt = make_ip(IP_PROTO_UDP, "8.8.8.8", "203.0.113.1", 53, port, 0);
+    assert(process(pkt) == PACKET_RESULT_FORWARD);
+    assert(has_tuple(pkt, "8.8.8.8", "192.168.1.11", 53, 5000) && checksums_ok(pkt));
+    packet_buffer_free(pkt);
+
+    // TCP and ICMP echo, the identifier standing in for the port
+    pkt = make_ip(IP_PROTO_TCP, "192.168.1.10", "198.51.100.1", 5001, 443, TCP_SYN);
+    assert(process(pkt) == PACKET_RESULT_FORWARD);
+    assert(has_tuple(pkt, "203.0.113.1", "198.51.100.1", 5001, 443) && checksums_ok(pkt));
+    packet_buffer_free(pkt);
+    pkt = make_ip(IP_PROTO_ICMP, "192.168.1.10", "198.51.100.1", 77, 0, 8);
+    assert(process(pkt) == PACKET_RESULT_FORWARD);
+    assert(has_tuple(pkt, "203.0.113.1", "198.51.100.1", 77, 0) && checksums_ok(pkt));
+    packet_buffer_free(pkt);
+    pkt = make_ip(IP_PROTO_ICMP, "198.51.100.1", "203.0.113.1", 77, 0, 0);
+    assert(process(pkt) == PACKET_RESULT_FORWARD);
+    assert(has_tuple(pkt, "198.51.100.1", "192.168.1.10", 77, 0) && checksums_ok(pkt));
+    packet_buffer_free(pkt);
+
+    stats = stats_now();
+    assert(stats.snat == before.snat + 4 && stats.translated == before.translated + 7);
+
+    // A range of two ports holds two connections and refuses the third
+    assert(conntrack_clear_nat_rules() == STATUS_SUCCESS);
+    rule.nat_addr_min = rule.nat_addr_max = ip4("203.0.113.2");
+    rule.nat_port_min = 40000;
+    rule.nat_port_max = 40001;
+    assert(conntrack_add_nat_rule(&rule) == STATUS_SUCCESS);
+    assert(send_one(IP_PROTO_UDP, "192.168.1.20", "8.8.4.4", 7000, 53, 0) == PACKET_RESULT_FORWARD);
+    assert(send_one(IP_PROTO_UDP, "192.168.1.21", "8.8.4.4", 7000, 53, 0) == PACKET_RESULT_FORWARD);
+    assert(send_one(IP_PROTO_UDP, "192.168.1.22", "8.8.4.4", 7000, 53, 0) == PACKET_RESULT_DROP);
+    assert(stats_now().nat_exhausted == before.nat_exhausted + 1);
+
+    // Connections keep their translation once the rules are gone
+    assert(conntrack_clear_nat_rules() == STATUS_SUCCESS);
+    pkt = make_ip(IP_PROTO_UDP, "192.168.1.10", "8.8.8.8", 5000, 53, 0);
+    assert(process(pkt) == PACKET_RESULT_FORWARD);
+    assert(has_tuple(pkt, "203.0.113.1", "8.8.8.8", 5000, 53) && checksums_ok(pkt));
+    packet_buffer_free(pkt);
+
+    printf(TEST_PASSED, "test_conntrack_snat");
+}
+
+void test_conntrack_dnat() {
+    conntrack_nat_rule_t rule = { .type = CONNTRACK_NAT_DNAT, .protocol = IP_PROTO_TCP,
+                                  .match_addr = ip4("198.51.100.10"), .match_prefix_len = 32,
+                                  .match_port = 80, .nat_addr_min = ip4("10.0.0.5"),
+                                  .nat_addr_max = ip4("10.0.0.5"), .nat_port_min = 8080 };
+    conntrack_stats_t before = stats_now(), stats;
+    packet_buffer_t *pkt;
+
+    assert(conntrack_add_nat_rule(&rule) == STATUS_SUCCESS);
+
+    // The service address is rewritten to the server, and back in replies
+    pkt = make_ip(IP_PROTO_TCP, "1.2.3.4", "198.51.100.10", 3333, 80, TCP_SYN);
+    assert(process(pkt) == PACKET_RESULT_FORWARD);
+    assert(has_tuple(pkt, "1.2.3.4", "10.0.0.5", 3333, 8080) && checksums_ok(pkt));
+    packet_buffer_free(pkt);
+    pkt = make_ip(IP_PROTO_TCP, "10.0.0.5", "1.2.3.4", 8080, 3333, TCP_SYN | TCP_ACK);
+    assert(process(pkt) == PACKET_RESULT_FORWARD);
+    assert(has_tuple(pkt, "198.51.100.10", "1.2.3.4", 80, 3333) && checksums_ok(pkt));
+    packet_buffer_free(pkt);
+
+    // Another port or protocol to the same address is left alone
+    pkt = make_ip(IP_PROTO_TCP, "1.2.3.4", "198.51.100.10", 3334, 443, TCP_SYN);
+    assert(process(pkt) == PACKET_RESULT_FORWARD);
+    assert(has_tuple(pkt, "1.2.3.4", "198.51.100.10", 3334, 443));
+    packet_buffer_free(pkt);
+    pkt = make_ip(IP_PROTO_UDP, "1.2.3.4", "198.51.100.10", 3335, 80, 0);
+    assert(process(pkt) == PACKET_RESULT_FORWARD);
+    assert(has_tuple(pkt, "1.2.3.4", "198.51.100.10", 3335, 80));
+    packet_buffer_free(pkt);
+
+    stats = stats_now();
+    assert(stats.dnat == before.dnat + 1 && stats.translated == before.translated + 2);
+    assert(stats.mirrors_sent == 0);
+    assert(conntrack_clear_nat_rules() == STATUS_SUCCESS);
+
+    printf(TEST_PASSED, "test_conntrack_dnat");
+}
+
+void test_conntrack_flush() {
+    conntrack_stats_t before = stats_now();
+
+    // The table empties on its next burst, and tracking starts over
+    assert(before.flows > 1);
+    assert(conntrack_flush() == STATUS_SUCCESS);
+    assert(send_one(IP_PROTO_UDP, "10.5.0.1", "10.6.0.1", 1000, 2000, 0) == PACKET_RESULT_FORWARD);
+    assert(stats_now().flows == 1 && stats_now().created == before.created + 1);
+
+    // Off, connections are kept but nothing new is tracked
+    assert(conntrack_set_enabled(false) == STATUS_SUCCESS);
+    assert(send_one(IP_PROTO_UDP, "10.5.0.2", "10.6.0.1", 1000, 2000, 0) == PACKET_RESULT_FORWARD);
+    assert(stats_now().flows == 1 && stats_now().created == before.created + 1);
+
+    assert(conntrack_cleanup() == STATUS_SUCCESS);
+    assert(conntrack_cleanup() == STATUS_NOT_INITIALIZED);
+    assert(send_one(IP_PROTO_UDP, "10.5.0.3", "10.6.0.1", 1000, 2000, 0) == PACKET_RESULT_FORWARD);
+
+    printf(TEST_PASSED, "test_conntrack_flush");
+}
+
+int main() {
+    printf("Running conntrack unit tests...\n");
+
+    assert(sim_clock_set_mode(SIM_CLOCK_VIRTUAL) == STATUS_SUCCESS);
+    assert(packet_init() == STATUS_SUCCESS);
+    assert(port_get_mac(PORT, &g_router_mac) == STATUS_SUCCESS);
+
+    test_conntrack_config();
+    test_conntrack_tracking();
+    test_conntrack_expiry();
+    test_conntrack_snat();
+    test_conntrack_dnat();
+    test_conntrack_flush();
+
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All conntrack tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,205 @@
+/**
+ * @file test_cpu_trap.c
+ * @brief Unit tests for the CPU trap ring in shared memory
+ *
+ * The test maps the segment a second time by name and reads it with the
+ * consumer helpers, as a process outside the simulator would.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../../include/hal/cpu_trap.h"
+#include "../../include/hal/packet.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define SLOTS 4
+#define SNAPLEN 64
+#define SHORT_LEN 60
+#define LONG_LEN 100
+
+static char g_name[64];
+
+/* A frame whose bytes count up from a seed */
+static packet_buffer_t *make_packet(uint32_t length, uint8_t seed, port_id_t port, uint16_t vlan) {
+    uint8_t frame[LONG_LEN];
+    packet_buffer_t *packet = packet_buffer_alloc(length);
+
+    for (uint32_t i = 0; i < length; i++) {
+        frame[i] = (uint8_t)(seed + i);
+    }
+    assert(packet != NULL);
+    assert(packet_append_data(packet, frame, length) == STATUS_SUCCESS);
+    packet->metadata.port = port;
+    packet->metadata.vlan = vlan;
+    return packet;
+}
+
+/* Map the ring as a consumer would */
+static cpu_trap_header_t *map_ring(size_t *size) {
+    cpu_trap_header_t header;
+    void *map;
+    int fd = shm_open(g_name, O_RDWR, 0);
+
+    assert(fd >= 0);
+    assert(read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header));
+    *size = header.total_size;
+    map = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    assert(map != MAP_FAILED);
+    return (cpu_trap_header_t *)map;
+}
+
+void test_cpu_trap_open() {
+    cpu_trap_header_t *hdr;
+    size_t size;
+
+    assert(!cpu_trap_enabled());
+    assert(cpu_trap_open("no_slash", SLOTS, SNAPLEN) == STATUS_INVALID_PARAMETER);
+    assert(cpu_trap_open(g_name, 3, SNAPLEN) == STATUS_INVALID_PARAMETER);
+    assert(cpu_trap_open(g_name, SLOTS, UINT16_MAX + 1) == STATUS_INVALID_PARAMETER);
+    assert(!cpu_trap_enabled());
+
+    assert(cpu_trap_open(g_name, SLOTS, SNAPLEN) == STATUS_SUCCESS);
+    assert(cpu_trap_enabled());
+    assert(cpu_trap_open(g_name, SLOTS, SNAPLEN) == STATUS_ALREADY_INITIALIZED);
+
+    // The header describes the layout to a consumer that knows nothing else
+    hdr = map_ring(&size);
+    assert(hdr->magic == CPU_TRAP_MAGIC && hdr->version_major == CPU_TRAP_VERSION_MAJOR);
+    assert(hdr->header_size == sizeof(cpu_trap_header_t) && hdr->writer_pid == (uint32_t)getpid());
+    assert(hdr->slot_count == SLOTS && hdr->snaplen == SNAPLEN);
+    assert(hdr->slot_size % 64 == 0 && hdr->slot_size >= sizeof(cpu_trap_record_t) + SNAPLEN);
+    assert(hdr->slots_offset % 64 == 0 && hdr->slots_offset >= sizeof(cpu_trap_header_t));
+    assert(hdr->total_size == hdr->slots_offset + (uint64_t)SLOTS * hdr->slot_size);
+    assert(hdr->head == 0 && hdr->tail == 0);
+    munmap(hdr, size);
+
+    printf(TEST_PASSED, "test_cpu_trap_open");
+}
+
+void test_cpu_trap_records() {
+    packet_buffer_t *pkts[2] = { make_packet(SHORT_LEN, 0x10, 3, 100), make_packet(LONG_LEN, 0x20, 7, 200) };
+    const cpu_trap_record_t *rec;
+    cpu_trap_header_t *hdr;
+    uint64_t pos;
+    size_t size;
+
+    hdr = map_ring(&size);
+    assert(cpu_trap_peek(hdr, &pos) == 0);
+    assert(cpu_trap_submit(pkts, 2, CPU_TRAP_REASON_ARP) == 2);
+    assert(cpu_trap_submit(pkts, 2, CPU_TRAP_REASON_COUNT) == 0);
+    assert(cpu_trap_submit(NULL, 2, CPU_TRAP_REASON_ARP) == 0);
+
+    // Both records are there, the long frame cut to the snap length
+    assert(cpu_trap_peek(hdr, &pos) == 2 && pos == 0);
+    rec = cpu_trap_record(hdr, pos);
+    assert(rec->orig_len == SHORT_LEN && rec->cap_len == SHORT_LEN && rec->flags == 0);
+    assert(rec->port == 3 && rec->vlan == 100 && rec->reason == CPU_TRAP_REASON_ARP);
+    assert(rec->timestamp_ns != 0 && memcmp(rec->data, pkts[0]->data, SHORT_LEN) == 0);
+    rec = cpu_trap_record(hdr, pos + 1);
+    assert(rec->orig_len == LONG_LEN && rec->cap_len == SNAPLEN && rec->flags == CPU_TRAP_FLAG_TRUNCATED);
+    assert(rec->port == 7 && rec->vlan == 200);
+    assert(memcmp(rec->data, pkts[1]->data, SNAPLEN) == 0);
+
+    // The packets stay with the caller
+    packet_buffer_free(pkts[0]);
+    packet_buffer_free(pkts[1]);
+
+    cpu_trap_release(hdr, pos + 2);
+    assert(cpu_trap_peek(hdr, &pos) == 0 && pos == 2);
+    munmap(hdr, size);
+
+    printf(TEST_PASSED, "test_cpu_trap_records");
+}
+
+void test_cpu_trap_full() {
+    packet_buffer_t *pkts[SLOTS + 2];
+    cpu_trap_stats_t stats;
+    cpu_trap_header_t *hdr;
+    uint64_t pos;
+    size_t size;
+
+    for (uint32_t i = 0; i < SLOTS + 2; i++) {
+        pkts[i] = make_packet(SHORT_LEN, (uint8_t)i, 1, 1);
+    }
+
+    // A ring the consumer does not drain takes what fits and counts the rest
+    hdr = map_ring(&size);
+    assert(cpu_trap_submit(pkts, SLOTS + 2, CPU_TRAP_REASON_OSPF) == SLOTS);
+    assert(cpu_trap_submit(pkts, 1, CPU_TRAP_REASON_OSPF) == 0);
+    assert(cpu_trap_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.trapped[CPU_TRAP_REASON_ARP] == 2 && stats.trapped[CPU_TRAP_REASON_OSPF] == SLOTS);
+    assert(stats.ring_full == 3 && stats.truncated == 1 && stats.depth == SLOTS);
+    assert(hdr->ring_full == 3 && hdr->trapped[CPU_TRAP_REASON_OSPF] == SLOTS);
+
+    // Records wrap around the slots once the consumer gives some back
+    assert(cpu_trap_peek(hdr, &pos) == SLOTS && pos == 2);
+    assert(cpu_trap_record(hdr, pos)->data[0] == 0);
+    cpu_trap_release(hdr, pos + 1);
+    assert(cpu_trap_submit(&pkts[SLOTS], 1, CPU_TRAP_REASON_OSPF) == 1);
+    assert(cpu_trap_peek(hdr, &pos) == SLOTS && pos == 3);
+    assert(cpu_trap_record(hdr, pos + SLOTS - 1) == cpu_trap_record(hdr, 2));
+    assert(cpu_trap_record(hdr, pos + SLOTS - 1)->data[0] == SLOTS);
+
+    // A tail past the head is not trusted: the ring stays full
+    cpu_trap_release(hdr, hdr->head + 1);
+    assert(cpu_trap_submit(pkts, 1, CPU_TRAP_REASON_OSPF) == 0);
+    assert(cpu_trap_get_stats(&stats) == STATUS_SUCCESS && stats.depth == SLOTS);
+    cpu_trap_release(hdr, hdr->head);
+    assert(cpu_trap_get_stats(&stats) == STATUS_SUCCESS && stats.depth == 0);
+    munmap(hdr, size);
+
+    for (uint32_t i = 0; i < SLOTS + 2; i++) {
+        packet_buffer_free(pkts[i]);
+    }
+
+    printf(TEST_PASSED, "test_cpu_trap_full");
+}
+
+void test_cpu_trap_close() {
+    packet_buffer_t *pkt = make_packet(SHORT_LEN, 0, 1, 1);
+    cpu_trap_stats_t stats;
+
+    // Closing unlinks the segment and stops the writes
+    cpu_trap_close();
+    assert(!cpu_trap_enabled());
+    assert(shm_open(g_name, O_RDONLY, 0) < 0);
+    assert(cpu_trap_submit(&pkt, 1, CPU_TRAP_REASON_ARP) == 0);
+    assert(cpu_trap_get_stats(&stats) == STATUS_NOT_INITIALIZED);
+    assert(cpu_trap_get_stats(NULL) == STATUS_INVALID_PARAMETER);
+    cpu_trap_close();
+
+    // It can be opened again, empty
+    assert(cpu_trap_open(g_name, 0, 0) == STATUS_SUCCESS);
+    assert(cpu_trap_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.depth == 0 && stats.ring_full == 0 && stats.trapped[CPU_TRAP_REASON_ARP] == 0);
+    cpu_trap_close();
+    packet_buffer_free(pkt);
+
+    printf(TEST_PASSED, "test_cpu_trap_close");
+}
+
+int main() {
+    printf("Running CPU trap unit tests...\n");
+
+    snprintf(g_name, sizeof(g_name), "/test_cpu_trap_%d", (int)getpid());
+    assert(packet_init() == STATUS_SUCCESS);
+
+    test_cpu_trap_open();
+    test_cpu_trap_records();
+    test_cpu_trap_full();
+    test_cpu_trap_close();
+
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All CPU trap tests completed successfully.\n");
+    return 0;
+}
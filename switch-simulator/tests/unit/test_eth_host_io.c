@@ -0,0 +1,190 @@
+/**
+ * @file test_eth_host_io.c
+ * @brief Unit tests for host interface backed Ethernet ports
+ *
+ * The ports are opened on the loopback interface, where every frame sent
+ * comes back as received. Opening a packet socket needs CAP_NET_RAW; the
+ * tests that do are skipped without it.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <arpa/inet.h>
+#include "../../drivers/include/eth_host_io.h"
+#include "../../include/hal/packet.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+#define TEST_SKIPPED "[ SKIPPED ] %s: %s\n"
+
+#define LOOPBACK "lo"
+#define TEST_ETHERTYPE 0x88B5       /* Local experimental */
+#define FRAME_LEN 64
+#define BURST 4
+#define RX_WAIT_MS 100
+#define RX_POLLS 20
+
+static bool can_open_packet_sockets(void) {
+    int fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+static packet_buffer_t *make_frame(uint8_t tag, uint32_t len) {
+    uint8_t *frame = calloc(1, len);
+    packet_buffer_t *pkt = packet_buffer_alloc(len);
+
+    assert(frame != NULL && pkt != NULL);
+    memset(frame, 0x02, 6);
+    memset(frame + 6, 0x04, 6);
+    frame[12] = TEST_ETHERTYPE >> 8;
+    frame[13] = TEST_ETHERTYPE & 0xFF;
+    frame[14] = tag;
+    assert(packet_append_data(pkt, frame, len) == STATUS_SUCCESS);
+    free(frame);
+    return pkt;
+}
+
+/* Receive until count test frames came back; other loopback traffic is dropped */
+static uint32_t receive_tags(eth_host_port_t *port, uint8_t *tags, uint32_t count) {
+    packet_buffer_t *pkts[BURST * 4];
+    uint32_t got = 0;
+
+    for (uint32_t poll = 0; poll < RX_POLLS && got < count; poll++) {
+        if (!eth_host_wait(port, RX_WAIT_MS)) {
+            continue;
+        }
+        uint32_t n = eth_host_rx_burst(port, pkts, BURST * 4);
+        for (uint32_t i = 0; i < n; i++) {
+            uint8_t header[15];
+            if (packet_copy_data(pkts[i], 0, header, sizeof(header)) == STATUS_SUCCESS &&
+                header[12] == (TEST_ETHERTYPE >> 8) && header[13] == (TEST_ETHERTYPE & 0xFF) && got < count) {
+                tags[got++] = header[14];
+            }
+            packet_buffer_free(pkts[i]);
+        }
+    }
+    return got;
+}
+
+void test_eth_host_open_errors() {
+    eth_host_config_t config = { .ifname = LOOPBACK, .backend = ETH_HOST_PACKET_MMAP };
+    eth_host_port_t *port = NULL;
+
+    assert(eth_host_open(NULL, &port) == STATUS_INVALID_PARAMETER);
+    config.ring_size = 1000;
+    assert(eth_host_open(&config, &port) == STATUS_INVALID_PARAMETER);
+    config.ring_size = ETH_HOST_MAX_RING_SIZE * 2;
+    assert(eth_host_open(&config, &port) == STATUS_INVALID_PARAMETER);
+    config.ring_size = 0;
+    config.ifname = "no-such-if0";
+    assert(eth_host_open(&config, &port) == STATUS_NOT_FOUND);
+    config.ifname = "an-interface-name-too-long";
+    assert(eth_host_open(&config, &port) == STATUS_INVALID_PARAMETER);
+    assert(port == NULL);
+
+    eth_host_close(NULL);
+    printf(TEST_PASSED, "test_eth_host_open_errors");
+}
+
+void test_eth_host_packet_mmap() {
+    eth_host_config_t config = { .ifname = LOOPBACK, .backend = ETH_HOST_PACKET_MMAP, .ring_size = 64 };
+    eth_host_port_t *port;
+    packet_buffer_t *pkts[BURST];
+    packet_buffer_t *big;
+    eth_host_stats_t stats;
+    uint8_t tags[BURST + 1];
+    uint32_t i;
+
+    if (!can_open_packet_sockets()) {
+        printf(TEST_SKIPPED, "test_eth_host_packet_mmap", "no CAP_NET_RAW");
+        return;
+    }
+
+    assert(eth_host_open(&config, &port) == STATUS_SUCCESS);
+    assert(eth_host_get_backend(port) == ETH_HOST_PACKET_MMAP);
+
+    // A burst is queued on the TX ring and sent with one kick
+    for (i = 0; i < BURST; i++) {
+        pkts[i] = make_frame((uint8_t)(0xA0 + i), FRAME_LEN);
+    }
+    assert(eth_host_tx_burst(port, pkts, BURST) == BURST);
+    eth_host_get_stats(port, &stats);
+    assert(stats.tx_packets == BURST && stats.tx_bytes == BURST * FRAME_LEN);
+    assert(stats.tx_kicks == 1 && stats.tx_copied == BURST);
+
+    // Loopback hands the frames back in order
+    assert(receive_tags(port, tags, BURST) == BURST);
+    for (i = 0; i < BURST; i++) {
+        assert(tags[i] == 0xA0 + i);
+    }
+    eth_host_get_stats(port, &stats);
+    assert(stats.rx_packets >= BURST);
+
+    // A copy leaves the caller its frame
+    pkts[0] = make_frame(0xB0, FRAME_LEN);
+    assert(eth_host_tx_copy(port, pkts[0]) == STATUS_SUCCESS);
+    assert(receive_tags(port, tags, 1) == 1 && tags[0] == 0xB0);
+    assert(pkts[0]->length == FRAME_LEN);
+    packet_buffer_free(pkts[0]);
+
+    // Frames over the MTU do not fit a ring frame; both ways count the drop
+    big = make_frame(0xC0, 1600);
+    assert(eth_host_tx_copy(port, big) == STATUS_INVALID_PARAMETER);
+    assert(eth_host_tx_burst(port, &big, 1) == 1);
+    eth_host_get_stats(port, &stats);
+    assert(stats.tx_dropped == 2 && stats.tx_packets == BURST + 1);
+
+    eth_host_close(port);
+    printf(TEST_PASSED, "test_eth_host_packet_mmap");
+}
+
+void test_eth_host_af_xdp_fallback() {
+    eth_host_config_t config = { .ifname = LOOPBACK, .backend = ETH_HOST_AF_XDP, .ring_size = 64 };
+    eth_host_port_t *port;
+    packet_buffer_t *pkt;
+    uint8_t tag;
+
+    if (!can_open_packet_sockets()) {
+        printf(TEST_SKIPPED, "test_eth_host_af_xdp_fallback", "no CAP_NET_RAW");
+        return;
+    }
+
+    // Whichever backend the host allows, the port moves frames
+    assert(eth_host_open(&config, &port) == STATUS_SUCCESS);
+    assert(eth_host_get_backend(port) == ETH_HOST_AF_XDP || eth_host_get_backend(port) == ETH_HOST_PACKET_MMAP);
+
+    pkt = make_frame(0xD0, FRAME_LEN);
+    assert(eth_host_tx_burst(port, &pkt, 1) == 1);
+    assert(receive_tags(port, &tag, 1) == 1 && tag == 0xD0);
+
+    eth_host_close(port);
+    printf(TEST_PASSED, "test_eth_host_af_xdp_fallback");
+}
+
+int main() {
+    printf("Running host interface unit tests...\n");
+
+    // Received frames go into pool buffers
+    assert(packet_init() == STATUS_SUCCESS);
+
+    test_eth_host_open_errors();
+    test_eth_host_packet_mmap();
+    test_eth_host_af_xdp_fallback();
+
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All host interface tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,298 @@
+/**
+ * @file test_event_bus.c
+ * @brief Unit tests for the internal event bus
+ *
+ * Events are posted through the event feed helpers, as producers do, and
+ * delivered either by the event loop or by calling the dispatch directly.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/common/event_bus.h"
+#include "../../include/common/event_loop.h"
+#include "../../include/common/config.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define MS 1000
+#define MAX_RECORDED 64
+#define OVERFLOW 5
+
+#define KIND(k) (1U << (k))
+#define MAC_KINDS (KIND(EVENT_FEED_MAC_LEARN) | KIND(EVENT_FEED_MAC_AGE))
+#define ROUTE_KINDS (KIND(EVENT_FEED_ROUTE_ADD) | KIND(EVENT_FEED_ROUTE_DELETE) | KIND(EVENT_FEED_ROUTE_CHANGE))
+
+typedef struct {
+    uint32_t calls;
+    uint32_t count;
+    event_feed_event_t events[MAX_RECORDED];
+} recorder_t;
+
+static event_timer_t g_stop;
+static recorder_t g_plain;
+static recorder_t g_coalesced;
+static uint32_t g_plain_id;
+static uint32_t g_coalesced_id;
+
+static void stop_loop(event_timer_t *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+    event_loop_stop();
+}
+
+static void run_for(uint32_t ms) {
+    assert(event_timer_start(&g_stop, ms * MS, 0) == STATUS_SUCCESS);
+    assert(event_loop_run() == STATUS_SUCCESS);
+}
+
+/* Keeps what fits and counts the rest */
+static void record(const event_feed_event_t *events, uint32_t count, void *user_data) {
+    recorder_t *rec = user_data;
+
+    assert(count > 0);
+    rec->calls++;
+    for (uint32_t i = 0; i < count; i++) {
+        if (rec->count < MAX_RECORDED) {
+            rec->events[rec->count] = events[i];
+        }
+        rec->count++;
+    }
+}
+
+static void reset(void) {
+    memset(&g_plain, 0, sizeof(g_plain));
+    memset(&g_coalesced, 0, sizeof(g_coalesced));
+}
+
+void test_event_bus_subscribe() {
+    event_bus_subscriber_stats_t sub_stats;
+    uint32_t id;
+
+    // Nothing to subscribe to before the bus exists
+    assert(event_bus_subscribe("early", MAC_KINDS, 0, record, &g_plain, &id) == STATUS_NOT_INITIALIZED);
+    assert(event_bus_init() == STATUS_SUCCESS);
+    assert(event_bus_init() == STATUS_ALREADY_INITIALIZED);
+
+    assert(event_bus_subscribe(NULL, MAC_KINDS, 0, record, &g_plain, &id) == STATUS_INVALID_PARAMETER);
+    assert(event_bus_subscribe("bad", 0, 0, record, &g_plain, &id) == STATUS_INVALID_PARAMETER);
+    assert(event_bus_subscribe("bad", KIND(EVENT_FEED_KIND_COUNT), 0, record, &g_plain, &id) ==
+           STATUS_INVALID_PARAMETER);
+    assert(event_bus_subscribe("bad", MAC_KINDS, 0x2, record, &g_plain, &id) == STATUS_INVALID_PARAMETER);
+    assert(event_bus_subscribe("bad", MAC_KINDS, 0, NULL, &g_plain, &id) == STATUS_INVALID_PARAMETER);
+    assert(event_bus_subscribe("bad", MAC_KINDS, 0, record, &g_plain, NULL) == STATUS_INVALID_PARAMETER);
+
+    // Producers post a kind only while someone wants it
+    assert(!event_feed_enabled(EVENT_FEED_LINK));
+    assert(event_bus_subscribe("plain", KIND(EVENT_FEED_LINK) | KIND(EVENT_FEED_STP_ROLE) | ROUTE_KINDS, 0,
+                               record, &g_plain, &g_plain_id) == STATUS_SUCCESS);
+    assert(event_bus_subscribe("coalesced", MAC_KINDS | KIND(EVENT_FEED_STP_ROLE) | ROUTE_KINDS,
+                               EVENT_BUS_COALESCE, record, &g_coalesced, &g_coalesced_id) == STATUS_SUCCESS);
+    assert(g_plain_id != g_coalesced_id);
+    assert(event_feed_enabled(EVENT_FEED_LINK) && event_feed_enabled(EVENT_FEED_MAC_AGE));
+
+    assert(event_bus_get_subscriber_stats(g_plain_id, &sub_stats) == STATUS_SUCCESS);
+    assert(sub_stats.delivered == 0 && sub_stats.calls == 0);
+    assert(event_bus_get_subscriber_stats(CONFIG_EVENT_BUS_MAX_SUBSCRIBERS, &sub_stats) == STATUS_NOT_FOUND);
+    assert(event_bus_get_subscriber_stats(g_plain_id, NULL) == STATUS_INVALID_PARAMETER);
+
+    printf(TEST_PASSED, "test_event_bus_subscribe");
+}
+
+void test_event_bus_delivery() {
+    mac_addr_t mac = { .addr = { 0x02, 0, 0, 0, 0, 0x11 } };
+    event_bus_stats_t stats;
+
+    // Posting only queues; the event loop delivers
+    reset();
+    event_feed_post_link(3, 1);
+    event_feed_post_mac(EVENT_FEED_MAC_LEARN, &mac, 10, 4);
+    event_feed_post_link(5, 0);
+    assert(g_plain.calls == 0 && g_coalesced.calls == 0);
+    run_for(5);
+
+    // Each subscriber gets its kinds only, in posting order, in one call
+    assert(g_plain.calls == 1 && g_plain.count == 2);
+    assert(g_plain.events[0].kind == EVENT_FEED_LINK && g_plain.events[0].port_id == 3);
+    assert(g_plain.events[0].new_value == 1);
+    assert(g_plain.events[1].kind == EVENT_FEED_LINK && g_plain.events[1].port_id == 5);
+    assert(g_coalesced.calls == 1 && g_coalesced.count == 1);
+    assert(g_coalesced.events[0].kind == EVENT_FEED_MAC_LEARN && g_coalesced.events[0].port_id == 4);
+    assert(g_coalesced.events[0].vlan_id == 10 && memcmp(g_coalesced.events[0].mac, mac.addr, MAC_ADDR_LEN) == 0);
+
+    assert(event_bus_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.published == 3 && stats.dropped == 0 && stats.batches == 1 && stats.subscribers == 2);
+
+    // A kind nobody wants is not published; what was queued goes nowhere
+    reset();
+    event_feed_post_mac(EVENT_FEED_MAC_LEARN, &mac, 10, 4);
+    event_bus_unsubscribe(g_coalesced_id);
+    assert(!event_feed_enabled(EVENT_FEED_MAC_LEARN));
+    event_feed_post_mac(EVENT_FEED_MAC_LEARN, &mac, 10, 4);
+    assert(event_bus_dispatch() == 1);
+    assert(g_plain.calls == 0 && g_coalesced.calls == 0);
+    assert(event_bus_subscribe("coalesced", MAC_KINDS | KIND(EVENT_FEED_STP_ROLE) | ROUTE_KINDS,
+                               EVENT_BUS_COALESCE, record, &g_coalesced, &g_coalesced_id) == STATUS_SUCCESS);
+
+    printf(TEST_PASSED, "test_event_bus_delivery");
+}
+
+void test_event_bus_coalesce() {
+    mac_addr_t mac_a = { .addr = { 0x02, 0, 0, 0, 0, 0xa } };
+    mac_addr_t mac_b = { .addr = { 0x02, 0, 0, 0, 0, 0xb } };
+    const uint8_t net1[4] = { 10, 1, 0, 0 };
+    const uint8_t net2[4] = { 10, 2, 0, 0 };
+    event_bus_subscriber_stats_t sub_stats;
+
+    reset();
+    event_feed_post_mac(EVENT_FEED_MAC_LEARN, &mac_a, 1, 1);
+    event_feed_post_mac(EVENT_FEED_MAC_LEARN, &mac_b, 1, 1);
+    event_feed_post_mac(EVENT_FEED_MAC_LEARN, &mac_a, 2, 1);
+    event_feed_post_mac(EVENT_FEED_MAC_AGE, &mac_a, 1, 1);
+    event_feed_post_stp_role(7, 1, 2);
+    event_feed_post_stp_role(7, 2, 3);
+    event_feed_post_route(EVENT_FEED_ROUTE_ADD, 0, net1, 16, false);
+    event_feed_post_route(EVENT_FEED_ROUTE_CHANGE, 0, net1, 16, false);
+    event_feed_post_route(EVENT_FEED_ROUTE_ADD, 0, net2, 16, false);
+    event_feed_post_route(EVENT_FEED_ROUTE_DELETE, 0, net2, 16, false);
+    event_feed_post_route(EVENT_FEED_ROUTE_ADD, 0, net2, 24, false);
+    assert(event_bus_dispatch() == 11);
+
+    // Without coalescing every event arrives
+    assert(g_plain.calls == 1 && g_plain.count == 7);
+    assert(g_plain.events[0].kind == EVENT_FEED_STP_ROLE && g_plain.events[1].kind == EVENT_FEED_STP_ROLE);
+
+    // With it, the latest per object survives, in the order of the latest events
+    assert(g_coalesced.calls == 1 && g_coalesced.count == 7);
+    assert(g_coalesced.events[0].kind == EVENT_FEED_MAC_LEARN);
+    assert(g_coalesced.events[0].mac[5] == 0xb);
+    assert(g_coalesced.events[1].kind == EVENT_FEED_MAC_LEARN && g_coalesced.events[1].vlan_id == 2);
+    assert(g_coalesced.events[2].kind == EVENT_FEED_MAC_AGE && g_coalesced.events[2].vlan_id == 1);
+
+    // A role change keeps the oldest role as its old value
+    assert(g_coalesced.events[3].kind == EVENT_FEED_STP_ROLE && g_coalesced.events[3].port_id == 7);
+    assert(g_coalesced.events[3].old_value == 1 && g_coalesced.events[3].new_value == 3);
+
+    // A route added and changed is still added; one added and deleted is deleted
+    assert(g_coalesced.events[4].kind == EVENT_FEED_ROUTE_ADD);
+    assert(memcmp(g_coalesced.events[4].addr, net1, sizeof(net1)) == 0);
+    assert(g_coalesced.events[5].kind == EVENT_FEED_ROUTE_DELETE);
+    assert(memcmp(g_coalesced.events[5].addr, net2, sizeof(net2)) == 0);
+    assert(g_coalesced.events[5].prefix_len == 16);
+    assert(g_coalesced.events[6].kind == EVENT_FEED_ROUTE_ADD && g_coalesced.events[6].prefix_len == 24);
+
+    assert(event_bus_get_subscriber_stats(g_coalesced_id, &sub_stats) == STATUS_SUCCESS);
+    assert(sub_stats.delivered == 7 && sub_stats.coalesced == 4 && sub_stats.calls == 1);
+
+    printf(TEST_PASSED, "test_event_bus_coalesce");
+}
+
+void test_event_bus_overflow() {
+    event_bus_stats_t before, after;
+
+    // A full ring drops and counts; the next dispatch takes it all in batches
+    reset();
+    assert(event_bus_get_stats(&before) == STATUS_SUCCESS);
+    for (uint32_t i = 0; i < CONFIG_EVENT_BUS_RING_SIZE + OVERFLOW; i++) {
+        event_feed_post_link((port_id_t)(i % 48), 1);
+    }
+    assert(event_bus_get_stats(&after) == STATUS_SUCCESS);
+    assert(after.published - before.published == CONFIG_EVENT_BUS_RING_SIZE);
+    assert(after.dropped - before.dropped == OVERFLOW);
+
+    assert(event_bus_dispatch() == CONFIG_EVENT_BUS_RING_SIZE);
+    assert(g_plain.count == CONFIG_EVENT_BUS_RING_SIZE);
+    assert(g_plain.calls == CONFIG_EVENT_BUS_RING_SIZE / CONFIG_EVENT_BUS_BATCH);
+    assert(event_bus_get_stats(&after) == STATUS_SUCCESS);
+    assert(after.batches - before.batches == CONFIG_EVENT_BUS_RING_SIZE / CONFIG_EVENT_BUS_BATCH);
+    assert(event_bus_dispatch() == 0);
+
+    // Room again
+    event_feed_post_link(1, 1);
+    assert(event_bus_dispatch() == 1);
+
+    printf(TEST_PASSED, "test_event_bus_overflow");
+}
+
+void test_event_bus_unsubscribe() {
+    event_bus_subscriber_stats_t sub_stats;
+    uint32_t ids[CONFIG_EVENT_BUS_MAX_SUBSCRIBERS];
+    char report[4096];
+    uint32_t id, extra = 0;
+
+    // The table fills up
+    for (uint32_t i = 0; i < CONFIG_EVENT_BUS_MAX_SUBSCRIBERS - 2; i++) {
+        assert(event_bus_subscribe("filler", MAC_KINDS, 0, record, &g_plain, &ids[extra++]) == STATUS_SUCCESS);
+    }
+    assert(event_bus_subscribe("one_too_many", MAC_KINDS, 0, record, &g_plain, &id) ==
+           STATUS_RESOURCE_EXHAUSTED);
+
+    assert(event_bus_report(report, sizeof(report)) > 0);
+    assert(strstr(report, "plain") != NULL && strstr(report, "coalesced") != NULL);
+    assert(strstr(report, "one_too_many") == NULL);
+
+    for (uint32_t i = 0; i < extra; i++) {
+        assert(event_bus_unsubscribe(ids[i]) == STATUS_SUCCESS);
+    }
+    assert(event_bus_unsubscribe(ids[0]) == STATUS_NOT_FOUND);
+    assert(event_bus_unsubscribe(CONFIG_EVENT_BUS_MAX_SUBSCRIBERS) == STATUS_NOT_FOUND);
+
+    // Events already queued are not delivered to a dropped subscriber
+    reset();
+    event_feed_post_link(2, 1);
+    assert(event_bus_unsubscribe(g_plain_id) == STATUS_SUCCESS);
+    assert(event_bus_get_subscriber_stats(g_plain_id, &sub_stats) == STATUS_NOT_FOUND);
+    assert(event_bus_dispatch() == 1);
+    assert(g_plain.calls == 0);
+    assert(!event_feed_enabled(EVENT_FEED_LINK));
+
+    printf(TEST_PASSED, "test_event_bus_unsubscribe");
+}
+
+void test_event_bus_shutdown() {
+    event_bus_stats_t stats;
+    uint32_t id;
+
+    // What is queued is delivered before the subscriptions go
+    reset();
+    event_feed_post_stp_role(9, 0, 1);
+    assert(event_bus_shutdown() == STATUS_SUCCESS);
+    assert(g_coalesced.calls == 1 && g_coalesced.events[0].port_id == 9);
+    assert(!event_feed_enabled(EVENT_FEED_STP_ROLE));
+    assert(event_bus_get_stats(&stats) == STATUS_SUCCESS && stats.subscribers == 0);
+    assert(event_bus_shutdown() == STATUS_NOT_INITIALIZED);
+    assert(event_bus_unsubscribe(g_coalesced_id) == STATUS_NOT_INITIALIZED);
+
+    // The bus comes back empty
+    assert(event_bus_init() == STATUS_SUCCESS);
+    reset();
+    assert(event_bus_subscribe("again", KIND(EVENT_FEED_LINK), 0, record, &g_plain, &id) == STATUS_SUCCESS);
+    event_feed_post_link(4, 1);
+    run_for(5);
+    assert(g_plain.calls == 1 && g_plain.count == 1 && g_plain.events[0].port_id == 4);
+    assert(event_bus_shutdown() == STATUS_SUCCESS);
+
+    printf(TEST_PASSED, "test_event_bus_shutdown");
+}
+
+int main() {
+    printf("Running event bus unit tests...\n");
+
+    assert(event_loop_init() == STATUS_SUCCESS);
+    event_timer_init(&g_stop, stop_loop, NULL);
+
+    test_event_bus_subscribe();
+    test_event_bus_delivery();
+    test_event_bus_coalesce();
+    test_event_bus_overflow();
+    test_event_bus_unsubscribe();
+    test_event_bus_shutdown();
+
+    assert(event_loop_shutdown() == STATUS_SUCCESS);
+
+    printf("All event bus tests completed successfully.\n");
+    return 0;
+}
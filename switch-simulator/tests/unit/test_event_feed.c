@@ -0,0 +1,233 @@
+/**
+ * @file test_event_feed.c
+ * @brief Unit tests for the control plane event feed
+ *
+ * The ring and its eventfd live until the process exits, so the tests
+ * run in order and drain what they post.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <poll.h>
+#include <pthread.h>
+#include "../../include/common/event_feed.h"
+#include "../../include/common/config.h"
+#include "../../include/l2/mac_table.h"
+#include "../../include/hal/port.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define PRODUCERS 4
+#define PER_PRODUCER 1000
+#define OVERFLOW 5
+#define BATCH 64
+
+static int g_fd = -1;
+
+/* Whether the eventfd is readable, without waiting */
+static bool fd_ready(void) {
+    struct pollfd pfd = { .fd = g_fd, .events = POLLIN };
+
+    return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+}
+
+static uint32_t drain(void) {
+    event_feed_event_t events[BATCH];
+    uint32_t count, total = 0;
+
+    do {
+        assert(event_feed_read(events, BATCH, &count) == STATUS_SUCCESS);
+        total += count;
+    } while (count == BATCH);
+    return total;
+}
+
+static void *produce(void *arg) {
+    uintptr_t id = (uintptr_t)arg;
+
+    for (uint32_t i = 0; i < PER_PRODUCER; i++) {
+        event_feed_post_stp_role((port_id_t)id, (uint8_t)(i & 0xff), (uint8_t)id);
+    }
+    return NULL;
+}
+
+void test_event_feed_subscribe() {
+    event_feed_event_t event, events[2];
+    uint32_t count = 1;
+
+    // Nothing can be read before the first subscription
+    assert(event_feed_read(&event, 1, &count) == STATUS_NOT_INITIALIZED);
+    assert(count == 0);
+    assert(event_feed_subscribe(1U << EVENT_FEED_KIND_COUNT, &g_fd) == STATUS_INVALID_PARAMETER);
+    assert(event_feed_read(NULL, 1, &count) == STATUS_INVALID_PARAMETER);
+    assert(event_feed_get_stats(NULL) == STATUS_INVALID_PARAMETER);
+
+    assert(event_feed_subscribe(1U << EVENT_FEED_LINK, &g_fd) == STATUS_SUCCESS);
+    assert(g_fd >= 0);
+    assert(event_feed_enabled(EVENT_FEED_LINK));
+    assert(!event_feed_enabled(EVENT_FEED_MAC_LEARN));
+    assert(!fd_ready());
+
+    // Kinds not subscribed to are not put on the ring
+    event_feed_post_stp_role(3, 1, 2);
+    assert(!fd_ready());
+
+    event_feed_post_link(7, 1);
+    assert(fd_ready());
+    assert(event_feed_read(events, 2, &count) == STATUS_SUCCESS);
+    assert(count == 1 && events[0].kind == EVENT_FEED_LINK);
+    assert(events[0].port_id == 7 && events[0].new_value == 1 && events[0].old_value == 0);
+    assert(!fd_ready());
+
+    printf(TEST_PASSED, "test_event_feed_subscribe");
+}
+
+void test_event_feed_kinds() {
+    const uint8_t v4[4] = { 10, 1, 0, 0 };
+    uint8_t v6[16] = { 0x20, 0x01, 0x0d, 0xb8 };
+    mac_addr_t mac = { .addr = { 0x02, 0, 0, 0, 0, 0x42 } };
+    event_feed_event_t events[4];
+    uint32_t count;
+
+    assert(event_feed_subscribe(EVENT_FEED_ALL_KINDS, NULL) == STATUS_SUCCESS);
+
+    event_feed_post_mac(EVENT_FEED_MAC_AGE, &mac, 20, 4);
+    event_feed_post_route(EVENT_FEED_ROUTE_ADD, 2, v4, 16, false);
+    event_feed_post_route(EVENT_FEED_ROUTE_DELETE, 0, v6, 32, true);
+    event_feed_post_stp_role(5, 1, 3);
+
+    // Events come back oldest first, with the fields of their kind
+    assert(event_feed_read(events, 4, &count) == STATUS_SUCCESS);
+    assert(count == 4);
+    assert(events[0].kind == EVENT_FEED_MAC_AGE && events[0].vlan_id == 20 && events[0].port_id == 4);
+    assert(memcmp(events[0].mac, mac.addr, MAC_ADDR_LEN) == 0);
+    assert(events[1].kind == EVENT_FEED_ROUTE_ADD && events[1].vlan_id == 2);
+    assert(events[1].prefix_len == 16 && !events[1].is_ipv6 && memcmp(events[1].addr, v4, 4) == 0);
+    assert(events[1].addr[4] == 0);
+    assert(events[2].kind == EVENT_FEED_ROUTE_DELETE && events[2].is_ipv6);
+    assert(events[2].prefix_len == 32 && memcmp(events[2].addr, v6, 16) == 0);
+    assert(events[3].kind == EVENT_FEED_STP_ROLE && events[3].port_id == 5);
+    assert(events[3].old_value == 1 && events[3].new_value == 3);
+    assert(events[0].timestamp_us <= events[3].timestamp_us);
+
+    // A full batch leaves the descriptor readable for what may remain
+    event_feed_post_link(1, 0);
+    assert(event_feed_read(events, 1, &count) == STATUS_SUCCESS);
+    assert(count == 1 && fd_ready());
+    assert(event_feed_read(events, 1, &count) == STATUS_SUCCESS);
+    assert(count == 0 && !fd_ready());
+
+    printf(TEST_PASSED, "test_event_feed_kinds");
+}
+
+void test_event_feed_mac_learning() {
+    mac_addr_t mac = { .addr = { 0x02, 0, 0, 0, 0, 0x07 } };
+    event_feed_event_t event;
+    uint32_t count;
+
+    // Bringing the ports up posts link changes, which are not wanted here
+    assert(event_feed_subscribe(1U << EVENT_FEED_MAC_LEARN, NULL) == STATUS_SUCCESS);
+    assert(port_init() == STATUS_SUCCESS);
+    assert(mac_table_init(1024, 300) == STATUS_SUCCESS);
+
+    // Learning a dynamic entry is reported; a static entry is not
+    assert(mac_table_add(mac, 3, 10, false) == STATUS_SUCCESS);
+    assert(event_feed_read(&event, 1, &count) == STATUS_SUCCESS);
+    assert(count == 1 && event.kind == EVENT_FEED_MAC_LEARN);
+    assert(event.port_id == 3 && event.vlan_id == 10 && memcmp(event.mac, mac.addr, MAC_ADDR_LEN) == 0);
+
+    mac.addr[5] = 0x08;
+    assert(mac_table_add(mac, 3, 10, true) == STATUS_SUCCESS);
+    assert(event_feed_read(&event, 1, &count) == STATUS_SUCCESS);
+    assert(count == 0);
+
+    assert(mac_table_deinit() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_event_feed_mac_learning");
+}
+
+void test_event_feed_producers() {
+    pthread_t threads[PRODUCERS];
+    uint32_t last[PRODUCERS];
+    event_feed_event_t events[BATCH];
+    event_feed_stats_t before, after;
+    uint32_t count, total = 0;
+
+    assert(event_feed_subscribe(1U << EVENT_FEED_STP_ROLE, NULL) == STATUS_SUCCESS);
+    assert(event_feed_get_stats(&before) == STATUS_SUCCESS);
+
+    for (uintptr_t i = 0; i < PRODUCERS; i++) {
+        assert(pthread_create(&threads[i], NULL, produce, (void *)i) == 0);
+    }
+    for (int i = 0; i < PRODUCERS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    // Every event arrives once, in order per producer
+    memset(last, 0xff, sizeof(last));
+    do {
+        assert(event_feed_read(events, BATCH, &count) == STATUS_SUCCESS);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t id = events[i].port_id;
+
+            assert(id < PRODUCERS && events[i].new_value == id);
+            assert((uint8_t)(last[id] + 1) == events[i].old_value);
+            last[id] = events[i].old_value;
+        }
+        total += count;
+    } while (count == BATCH);
+    assert(total == PRODUCERS * PER_PRODUCER);
+
+    assert(event_feed_get_stats(&after) == STATUS_SUCCESS);
+    assert(after.posted - before.posted == total);
+    assert(after.read - before.read == total);
+    assert(after.dropped == before.dropped);
+
+    printf(TEST_PASSED, "test_event_feed_producers");
+}
+
+void test_event_feed_overflow() {
+    event_feed_stats_t before, after;
+
+    assert(event_feed_get_stats(&before) == STATUS_SUCCESS);
+
+    // A full ring drops and counts; posting never blocks
+    for (uint32_t i = 0; i < CONFIG_EVENT_FEED_RING_SIZE + OVERFLOW; i++) {
+        event_feed_post_stp_role(1, 0, 1);
+    }
+    assert(event_feed_get_stats(&after) == STATUS_SUCCESS);
+    assert(after.posted - before.posted == CONFIG_EVENT_FEED_RING_SIZE);
+    assert(after.dropped - before.dropped == OVERFLOW);
+
+    assert(fd_ready());
+    assert(drain() == CONFIG_EVENT_FEED_RING_SIZE);
+    assert(!fd_ready());
+
+    // The drained ring takes events again
+    event_feed_post_stp_role(1, 0, 1);
+    assert(drain() == 1);
+
+    // Unsubscribing stops the posts
+    assert(event_feed_subscribe(0, NULL) == STATUS_SUCCESS);
+    assert(!event_feed_enabled(EVENT_FEED_STP_ROLE));
+    event_feed_post_link(1, 1);
+    assert(drain() == 0);
+
+    printf(TEST_PASSED, "test_event_feed_overflow");
+}
+
+int main() {
+    printf("Running event feed unit tests...\n");
+
+    test_event_feed_subscribe();
+    test_event_feed_kinds();
+    test_event_feed_mac_learning();
+    test_event_feed_producers();
+    test_event_feed_overflow();
+
+    printf("All event feed tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,222 @@
+/**
+ * @file test_event_loop.c
+ * @brief Unit tests for the event loop and timer wheel
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include "../../include/common/event_loop.h"
+#include "../../include/common/config.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define MANY_TIMERS 200000
+
+typedef struct {
+    int order[8];
+    int count;
+} order_log_t;
+
+typedef struct {
+    order_log_t *log;
+    int id;
+} order_arg_t;
+
+static void log_order(event_timer_t *timer, void *arg) {
+    order_arg_t *a = (order_arg_t *)arg;
+    (void)timer;
+    a->log->order[a->log->count++] = a->id;
+    if (a->log->count == 4) {
+        event_loop_stop();
+    }
+}
+
+static void stop_loop(event_timer_t *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+    event_loop_stop();
+}
+
+void test_event_timer_order() {
+    order_log_t log = { .count = 0 };
+    order_arg_t args[4];
+    event_timer_t timers[4];
+    const uint64_t delays[4] = { 30000, 5000, 20000, 10000 };
+
+    for (int i = 0; i < 4; i++) {
+        args[i].log = &log;
+        args[i].id = i;
+        event_timer_init(&timers[i], log_order, &args[i]);
+        assert(event_timer_start(&timers[i], delays[i], 0) == STATUS_SUCCESS);
+        assert(event_timer_pending(&timers[i]));
+    }
+
+    assert(event_loop_run() == STATUS_SUCCESS);
+
+    assert(log.count == 4);
+    assert(log.order[0] == 1);
+    assert(log.order[1] == 3);
+    assert(log.order[2] == 2);
+    assert(log.order[3] == 0);
+    for (int i = 0; i < 4; i++) {
+        assert(!event_timer_pending(&timers[i]));
+    }
+
+    printf(TEST_PASSED, "test_event_timer_order");
+}
+
+static void count_and_stop(event_timer_t *timer, void *arg) {
+    int *count = (int *)arg;
+    if (++(*count) == 5) {
+        assert(event_timer_stop(timer));
+        event_loop_stop();
+    }
+}
+
+void test_event_timer_periodic() {
+    event_timer_t timer;
+    int count = 0;
+    uint64_t start = event_loop_now_us();
+
+    event_timer_init(&timer, count_and_stop, &count);
+    assert(event_timer_start(&timer, 2000, 2000) == STATUS_SUCCESS);
+    assert(event_loop_run() == STATUS_SUCCESS);
+
+    assert(count == 5);
+    assert(!event_timer_pending(&timer));
+    assert(event_loop_now_us() - start >= 10000);
+
+    printf(TEST_PASSED, "test_event_timer_periodic");
+}
+
+void test_event_timer_stop() {
+    event_timer_t cancelled;
+    event_timer_t guard;
+    int count = 0;
+
+    event_timer_init(&cancelled, count_and_stop, &count);
+    event_timer_init(&guard, stop_loop, NULL);
+    assert(event_timer_start(&cancelled, 1000, 0) == STATUS_SUCCESS);
+    assert(event_timer_start(&guard, 5000, 0) == STATUS_SUCCESS);
+
+    assert(event_timer_stop(&cancelled));
+    assert(!event_timer_stop(&cancelled));
+    assert(event_loop_run() == STATUS_SUCCESS);
+    assert(count == 0);
+
+    // Restarting a pending timer moves its deadline
+    event_timer_init(&guard, stop_loop, NULL);
+    assert(event_timer_start(&guard, 1000000, 0) == STATUS_SUCCESS);
+    assert(event_timer_start(&guard, 1000, 0) == STATUS_SUCCESS);
+    uint64_t start = event_loop_now_us();
+    assert(event_loop_run() == STATUS_SUCCESS);
+    assert(event_loop_now_us() - start < 500000);
+
+    printf(TEST_PASSED, "test_event_timer_stop");
+}
+
+static event_timer_t *g_many;
+static uint64_t g_many_fired;
+
+static void many_cb(event_timer_t *timer, void *arg) {
+    uint64_t due = (uint64_t)(uintptr_t)arg;
+    (void)timer;
+    // Never early
+    assert(event_loop_now_us() + CONFIG_EVENT_LOOP_TICK_US >= due);
+    if (++g_many_fired == MANY_TIMERS) {
+        event_loop_stop();
+    }
+}
+
+void test_event_timer_many() {
+    event_loop_stats_t stats;
+    uint64_t now = event_loop_now_us();
+
+    g_many = (event_timer_t *)calloc(MANY_TIMERS, sizeof(event_timer_t));
+    assert(g_many != NULL);
+    g_many_fired = 0;
+
+    // Spread deadlines over 0..300 ms so several wheel levels are used
+    for (int i = 0; i < MANY_TIMERS; i++) {
+        uint64_t delay = ((uint64_t)i * 7919) % 300000;
+        event_timer_init(&g_many[i], many_cb, (void *)(uintptr_t)(now + delay));
+        assert(event_timer_start(&g_many[i], delay, 0) == STATUS_SUCCESS);
+    }
+
+    // Cancel every tenth timer; they must not fire
+    for (int i = 0; i < MANY_TIMERS; i += 10) {
+        assert(event_timer_stop(&g_many[i]));
+        g_many_fired++;
+    }
+
+    assert(event_loop_run() == STATUS_SUCCESS);
+    assert(g_many_fired == MANY_TIMERS);
+
+    assert(event_loop_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.timers_pending == 0);
+
+    free(g_many);
+    printf(TEST_PASSED, "test_event_timer_many");
+}
+
+static void *stop_from_thread(void *arg) {
+    (void)arg;
+    usleep(10000);
+    event_loop_stop();
+    return NULL;
+}
+
+static void pipe_cb(int fd, uint32_t events, void *arg) {
+    char c;
+    (void)events;
+    if (read(fd, &c, 1) == 1) {
+        (*(int *)arg)++;
+    }
+}
+
+void test_event_loop_fd_and_stop() {
+    int fds[2];
+    int reads = 0;
+    pthread_t thread;
+
+    assert(pipe(fds) == 0);
+    assert(event_loop_add_fd(fds[0], EPOLLIN, pipe_cb, &reads) == STATUS_SUCCESS);
+    assert(write(fds[1], "x", 1) == 1);
+
+    // With no timers pending the loop sleeps until woken from another thread
+    assert(pthread_create(&thread, NULL, stop_from_thread, NULL) == 0);
+    assert(event_loop_run() == STATUS_SUCCESS);
+    pthread_join(thread, NULL);
+    assert(reads == 1);
+
+    assert(event_loop_remove_fd(fds[0]) == STATUS_SUCCESS);
+    assert(event_loop_remove_fd(fds[0]) == STATUS_NOT_FOUND);
+    close(fds[0]);
+    close(fds[1]);
+
+    printf(TEST_PASSED, "test_event_loop_fd_and_stop");
+}
+
+int main() {
+    printf("Running Event loop unit tests...\n");
+
+    assert(event_loop_init() == STATUS_SUCCESS);
+
+    test_event_timer_order();
+    test_event_timer_periodic();
+    test_event_timer_stop();
+    test_event_timer_many();
+    test_event_loop_fd_and_stop();
+
+    assert(event_loop_shutdown() == STATUS_SUCCESS);
+
+    printf("All Event loop tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,415 @@
+/**
+ * @file test_event_task.c
+ * @brief Unit tests for the cooperative task runtime
+ *
+ * The event loop runs on the virtual clock, so sleeps end at known times.
+ * Tasks keep their state in a context struct, as the runtime requires.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include "../../include/common/event_task.h"
+#include "../../include/common/event_loop.h"
+#include "../../include/common/sim_clock.h"
+#include "../../include/common/config.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define MS 1000
+#define YIELDS 3
+#define LOG_SIZE 32
+#define QUEUE_SIZE 64
+#define PUSHES 10000
+
+typedef struct {
+    char id;
+    uint32_t steps;
+    uint32_t i;
+    uint64_t delay_us;
+    uint64_t started_us;
+    uint64_t woke_us;
+    bool flag;
+    bool stop_when_done;
+    event_task_queue_t *queue;
+    void *item;
+    uint32_t items;
+    uint64_t sum;
+    uint32_t nulls;
+} ctx_t;
+
+static event_timer_t g_stop;
+static char g_log[LOG_SIZE];
+static uint32_t g_log_len;
+
+static void stop_loop(event_timer_t *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+    event_loop_stop();
+}
+
+static void run_for(uint64_t us) {
+    assert(event_timer_start(&g_stop, us, 0) == STATUS_SUCCESS);
+    assert(event_loop_run() == STATUS_SUCCESS);
+}
+
+static void log_step(char id) {
+    assert(g_log_len < LOG_SIZE - 1);
+    g_log[g_log_len++] = id;
+    g_log[g_log_len] = '\0';
+}
+
+/* Logs its id and yields, steps times */
+static int yield_task(event_task_t *task) {
+    ctx_t *ctx = task->arg;
+
+    EVENT_TASK_BEGIN(task);
+    for (ctx->i = 0; ctx->i < ctx->steps; ctx->i++) {
+        log_step(ctx->id);
+        EVENT_TASK_YIELD(task);
+    }
+    EVENT_TASK_END(task);
+}
+
+/* Sleeps once for delay_us and notes when it woke */
+static int sleep_task(event_task_t *task) {
+    ctx_t *ctx = task->arg;
+
+    EVENT_TASK_BEGIN(task);
+    ctx->started_us = event_loop_now_us();
+    EVENT_TASK_SLEEP(task, ctx->delay_us);
+    ctx->woke_us = event_loop_now_us();
+    EVENT_TASK_END(task);
+}
+
+/* Waits for the flag */
+static int wait_task(event_task_t *task) {
+    ctx_t *ctx = task->arg;
+
+    EVENT_TASK_BEGIN(task);
+    EVENT_TASK_WAIT_UNTIL(task, ctx->flag);
+    ctx->woke_us = event_loop_now_us();
+    EVENT_TASK_END(task);
+}
+
+/* Sums the items of its queue until it has steps of them */
+static int pop_task(event_task_t *task) {
+    ctx_t *ctx = task->arg;
+
+    EVENT_TASK_BEGIN(task);
+    while (ctx->items < ctx->steps) {
+        EVENT_TASK_POP(task, ctx->queue, ctx->item);
+        ctx->items++;
+        ctx->sum += (uintptr_t)ctx->item;
+    }
+    if (ctx->stop_when_done) {
+        event_loop_stop();
+    }
+    EVENT_TASK_END(task);
+}
+
+/* Pops with a timeout, steps times, counting the timeouts */
+static int pop_timeout_task(event_task_t *task) {
+    ctx_t *ctx = task->arg;
+
+    EVENT_TASK_BEGIN(task);
+    for (ctx->i = 0; ctx->i < ctx->steps; ctx->i++) {
+        EVENT_TASK_POP_TIMEOUT(task, ctx->queue, ctx->item, ctx->delay_us);
+        if (ctx->item == NULL) {
+            ctx->nulls++;
+        } else {
+            ctx->items++;
+            ctx->sum += (uintptr_t)ctx->item;
+        }
+    }
+    ctx->woke_us = event_loop_now_us();
+    EVENT_TASK_END(task);
+}
+
+static void set_flag(event_timer_t *timer, void *arg) {
+    event_task_t *task = arg;
+
+    (void)timer;
+    ((ctx_t *)task->arg)->flag = true;
+    event_task_wake(task);
+}
+
+static void push_item(event_timer_t *timer, void *arg) {
+    (void)timer;
+    assert(event_task_queue_push(arg, (void *)(uintptr_t)7));
+}
+
+static void *producer(void *arg) {
+    for (uintptr_t i = 1; i <= PUSHES; i++) {
+        while (!event_task_queue_push(arg, (void *)i)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+void test_event_task_init() {
+    event_task_runtime_stats_t stats;
+    event_task_t task;
+    ctx_t ctx;
+
+    memset(&task, 0, sizeof(task));
+    memset(&ctx, 0, sizeof(ctx));
+    assert(event_task_spawn(&task, "early", yield_task, &ctx) == STATUS_NOT_INITIALIZED);
+    assert(event_task_init(-1) == STATUS_SUCCESS);
+    assert(event_task_init(-1) == STATUS_ALREADY_INITIALIZED);
+    assert(event_task_spawn(NULL, "bad", yield_task, &ctx) == STATUS_INVALID_PARAMETER);
+    assert(event_task_spawn(&task, NULL, yield_task, &ctx) == STATUS_INVALID_PARAMETER);
+    assert(event_task_spawn(&task, "bad", NULL, &ctx) == STATUS_INVALID_PARAMETER);
+    assert(event_task_get_runtime_stats(NULL) == STATUS_INVALID_PARAMETER);
+
+    assert(event_task_get_runtime_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.tasks == 0 && stats.runs == 0 && stats.cpu == -1);
+
+    printf(TEST_PASSED, "test_event_task_init");
+}
+
+void test_event_task_yield() {
+    event_task_runtime_stats_t stats;
+    event_task_stats_t task_stats;
+    event_task_t a, b;
+    ctx_t ctx_a, ctx_b;
+
+    memset(&a, 0, sizeof(a));
+    memset(&b, 0, sizeof(b));
+    memset(&ctx_a, 0, sizeof(ctx_a));
+    memset(&ctx_b, 0, sizeof(ctx_b));
+    ctx_a.id = 'a';
+    ctx_a.steps = YIELDS;
+    ctx_b.id = 'b';
+    ctx_b.steps = YIELDS;
+    g_log_len = 0;
+
+    // Spawning only queues the first run
+    assert(event_task_spawn(&a, "yield_a", yield_task, &ctx_a) == STATUS_SUCCESS);
+    assert(event_task_spawn(&b, "yield_b", yield_task, &ctx_b) == STATUS_SUCCESS);
+    assert(event_task_spawn(&a, "yield_a", yield_task, &ctx_a) == STATUS_ALREADY_EXISTS);
+    assert(g_log_len == 0);
+    assert(event_task_get_runtime_stats(&stats) == STATUS_SUCCESS && stats.tasks == 2);
+
+    // Yielding tasks take turns, and finish once past the end
+    run_for(MS);
+    assert(strcmp(g_log, "ababab") == 0);
+    assert(a.state == EVENT_TASK_IDLE && b.state == EVENT_TASK_IDLE);
+    event_task_get_stats(&a, &task_stats);
+    assert(task_stats.runs == YIELDS + 1 && task_stats.wakeups == YIELDS + 1 && task_stats.timeouts == 0);
+    assert(event_task_get_runtime_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.tasks == 0 && stats.runs == 2 * (YIELDS + 1) && stats.passes >= YIELDS + 1);
+
+    // A finished task can be spawned again
+    g_log_len = 0;
+    ctx_a.steps = 1;
+    assert(event_task_spawn(&a, "yield_a", yield_task, &ctx_a) == STATUS_SUCCESS);
+    run_for(MS);
+    assert(strcmp(g_log, "a") == 0 && a.state == EVENT_TASK_IDLE);
+
+    printf(TEST_PASSED, "test_event_task_yield");
+}
+
+void test_event_task_sleep() {
+    event_task_stats_t task_stats;
+    event_timer_t wake;
+    event_task_t task;
+    ctx_t ctx;
+
+    // A sleep ends on its timer
+    memset(&task, 0, sizeof(task));
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.delay_us = 50 * MS;
+    assert(event_task_spawn(&task, "sleeper", sleep_task, &ctx) == STATUS_SUCCESS);
+    run_for(10 * MS);
+    assert(ctx.started_us != 0 && ctx.woke_us == 0 && task.state == EVENT_TASK_SLEEPING);
+    run_for(100 * MS);
+    assert(ctx.woke_us - ctx.started_us >= ctx.delay_us);
+    assert(ctx.woke_us - ctx.started_us <= ctx.delay_us + CONFIG_EVENT_LOOP_TICK_US);
+    event_task_get_stats(&task, &task_stats);
+    assert(task_stats.runs == 2 && task_stats.timeouts == 1);
+
+    // A wakeup cuts it short and its timer no longer fires
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.delay_us = 1000 * MS;
+    assert(event_task_spawn(&task, "sleeper", sleep_task, &ctx) == STATUS_SUCCESS);
+    run_for(10 * MS);
+    event_task_wake(&task);
+    run_for(2000 * MS);
+    assert(ctx.woke_us - ctx.started_us < 20 * MS);
+    event_task_get_stats(&task, &task_stats);
+    assert(task_stats.runs == 2 && task_stats.timeouts == 0);
+
+    // A wait holds until its condition is true when woken
+    memset(&ctx, 0, sizeof(ctx));
+    assert(event_task_spawn(&task, "waiter", wait_task, &ctx) == STATUS_SUCCESS);
+    run_for(10 * MS);
+    event_task_wake(&task);
+    run_for(10 * MS);
+    assert(ctx.woke_us == 0 && task.state == EVENT_TASK_SLEEPING);
+    event_timer_init(&wake, set_flag, &task);
+    assert(event_timer_start(&wake, 5 * MS, 0) == STATUS_SUCCESS);
+    run_for(10 * MS);
+    assert(ctx.woke_us != 0 && task.state == EVENT_TASK_IDLE);
+    event_task_get_stats(&task, &task_stats);
+    assert(task_stats.runs == 3);
+
+    printf(TEST_PASSED, "test_event_task_sleep");
+}
+
+void test_event_task_queue() {
+    event_task_queue_t queue;
+    event_timer_t push;
+    event_task_t task;
+    pthread_t thread;
+    uint64_t dropped;
+    ctx_t ctx;
+
+    assert(event_task_queue_init(&queue, 3) == STATUS_INVALID_PARAMETER);
+    assert(event_task_queue_init(&queue, 0) == STATUS_INVALID_PARAMETER);
+    assert(event_task_queue_init(NULL, QUEUE_SIZE) == STATUS_INVALID_PARAMETER);
+    assert(event_task_queue_init(&queue, QUEUE_SIZE) == STATUS_SUCCESS);
+
+    // Items pushed from another thread wake the task, none lost
+    memset(&task, 0, sizeof(task));
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.queue = &queue;
+    ctx.steps = PUSHES;
+    ctx.stop_when_done = true;
+    assert(event_task_spawn(&task, "consumer", pop_task, &ctx) == STATUS_SUCCESS);
+    assert(pthread_create(&thread, NULL, producer, &queue) == 0);
+    assert(event_loop_run() == STATUS_SUCCESS);
+    assert(pthread_join(thread, NULL) == 0);
+    assert(ctx.items == PUSHES && ctx.sum == (uint64_t)PUSHES * (PUSHES + 1) / 2);
+    assert(task.state == EVENT_TASK_IDLE && queue.waiter == NULL);
+
+    // A full queue refuses and counts
+    dropped = queue.dropped;
+    for (uintptr_t i = 1; i <= QUEUE_SIZE; i++) {
+        assert(event_task_queue_push(&queue, (void *)i));
+    }
+    assert(!event_task_queue_push(&queue, (void *)1));
+    assert(queue.dropped == dropped + 1);
+    while (event_task_queue_pop(&queue) != NULL) {
+    }
+
+    // A timed pop gives NULL after the timeout, or the item pushed before it
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.queue = &queue;
+    ctx.steps = 2;
+    ctx.delay_us = 20 * MS;
+    assert(event_task_spawn(&task, "timed", pop_timeout_task, &ctx) == STATUS_SUCCESS);
+    event_timer_init(&push, push_item, &queue);
+    assert(event_timer_start(&push, 30 * MS, 0) == STATUS_SUCCESS);
+    run_for(100 * MS);
+    assert(ctx.nulls == 1 && ctx.items == 1 && ctx.sum == 7);
+    assert(task.state == EVENT_TASK_IDLE && queue.waiter == NULL && task.stats.timeouts == 1);
+
+    event_task_queue_destroy(&queue);
+    assert(queue.ring == NULL);
+
+    printf(TEST_PASSED, "test_event_task_queue");
+}
+
+void test_event_task_cancel() {
+    event_task_runtime_stats_t stats;
+    event_task_queue_t queue;
+    event_task_t task, waiter;
+    ctx_t ctx, wctx;
+
+    // A queued task cancelled before its first run never runs
+    memset(&task, 0, sizeof(task));
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.id = 'c';
+    ctx.steps = YIELDS;
+    g_log_len = 0;
+    assert(event_task_spawn(&task, "cancelled", yield_task, &ctx) == STATUS_SUCCESS);
+    event_task_cancel(&task);
+    assert(task.state == EVENT_TASK_IDLE);
+    run_for(MS);
+    assert(g_log_len == 0);
+
+    // Nor does a sleeping one, once its timer would have fired
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.delay_us = 10 * MS;
+    assert(event_task_spawn(&task, "cancelled", sleep_task, &ctx) == STATUS_SUCCESS);
+    run_for(MS);
+    event_task_cancel(&task);
+    run_for(50 * MS);
+    assert(ctx.started_us != 0 && ctx.woke_us == 0 && task.stats.runs == 1);
+
+    // A task cancelled while waiting on a queue stops being its waiter
+    assert(event_task_queue_init(&queue, QUEUE_SIZE) == STATUS_SUCCESS);
+    memset(&waiter, 0, sizeof(waiter));
+    memset(&wctx, 0, sizeof(wctx));
+    wctx.queue = &queue;
+    wctx.steps = 1;
+    assert(event_task_spawn(&waiter, "cancelled_pop", pop_task, &wctx) == STATUS_SUCCESS);
+    run_for(MS);
+    assert(queue.waiter == &waiter);
+    event_task_cancel(&waiter);
+    assert(queue.waiter == NULL);
+    assert(event_task_queue_push(&queue, (void *)1));
+    run_for(MS);
+    assert(wctx.items == 0 && waiter.stats.runs == 1);
+    event_task_queue_destroy(&queue);
+
+    assert(event_task_get_runtime_stats(&stats) == STATUS_SUCCESS && stats.tasks == 0);
+
+    printf(TEST_PASSED, "test_event_task_cancel");
+}
+
+void test_event_task_shutdown() {
+    event_task_runtime_stats_t stats;
+    event_task_t task;
+    char report[2048];
+    ctx_t ctx;
+
+    memset(&task, 0, sizeof(task));
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.delay_us = 1000 * MS;
+    assert(event_task_spawn(&task, "sleeper_to_drop", sleep_task, &ctx) == STATUS_SUCCESS);
+    run_for(MS);
+
+    assert(event_task_report(report, sizeof(report)) > 0);
+    assert(strstr(report, "Control tasks: 1") != NULL);
+    assert(strstr(report, "sleeper_to_drop") != NULL && strstr(report, "sleeping") != NULL);
+    assert(event_task_report(NULL, sizeof(report)) == 0);
+
+    // Tasks still spawned are dropped, not run
+    assert(event_task_shutdown() == STATUS_SUCCESS);
+    assert(task.state == EVENT_TASK_IDLE);
+    run_for(2000 * MS);
+    assert(ctx.woke_us == 0);
+    assert(event_task_get_runtime_stats(&stats) == STATUS_SUCCESS && stats.tasks == 0);
+    assert(event_task_shutdown() == STATUS_NOT_INITIALIZED);
+    assert(event_task_spawn(&task, "late", sleep_task, &ctx) == STATUS_NOT_INITIALIZED);
+
+    printf(TEST_PASSED, "test_event_task_shutdown");
+}
+
+int main() {
+    printf("Running task runtime unit tests...\n");
+
+    assert(sim_clock_set_mode(SIM_CLOCK_VIRTUAL) == STATUS_SUCCESS);
+    assert(event_loop_init() == STATUS_SUCCESS);
+    event_timer_init(&g_stop, stop_loop, NULL);
+
+    test_event_task_init();
+    test_event_task_yield();
+    test_event_task_sleep();
+    test_event_task_queue();
+    test_event_task_cancel();
+    test_event_task_shutdown();
+
+    assert(event_loop_shutdown() == STATUS_SUCCESS);
+
+    printf("All task runtime tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,308 @@
+/**
+ * @file test_forwarding.c
+ * @brief Unit tests for the forwarding workers and their idle policy
+ *
+ * Workers run on real threads, so the tests wait for counters to move,
+ * up to WAIT_MS, rather than for fixed times.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "../../include/hal/forwarding.h"
+#include "../../include/hal/hw_simulation.h"
+#include "../../include/hal/hw_resources.h"
+#include "../../include/hal/packet.h"
+#include "../../include/hal/port.h"
+#include "../../include/l3/arp.h"
+#include "../../include/l3/ip.h"
+#include "../../include/l3/ip_processing.h"
+#include "../../include/l3/routing_table.h"
+#include "../../include/common/config.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define WORKERS 2
+#define FRAME_LEN 60
+#define PORT_A 1
+#define PORT_B 2
+#define WAIT_MS 5000
+#define ETH_HDR_LEN 14
+#define IP_HDR_LEN 20
+
+static routing_table_t g_table;
+
+/* Declared in management/stats.h for ip_processing_init(), which nothing here collects */
+status_t stats_register_counter(const char *counter_name, uint64_t *counter_ptr) {
+    (void)counter_name;
+    (void)counter_ptr;
+    return STATUS_SUCCESS;
+}
+
+/* Counters of all workers added up */
+static forwarding_worker_stats_t total_stats(void) {
+    forwarding_worker_stats_t total, stats;
+
+    memset(&total, 0, sizeof(total));
+    for (uint32_t w = 0; w < forwarding_get_worker_count(); w++) {
+        assert(forwarding_get_worker_stats(w, &stats) == STATUS_SUCCESS);
+        total.rx_packets += stats.rx_packets;
+        total.processed += stats.processed;
+        total.idle_polls += stats.idle_polls;
+        total.spin_ns += stats.spin_ns;
+        total.pause_ns += stats.pause_ns;
+        total.block_ns += stats.block_ns;
+        total.blocks += stats.blocks;
+        total.wakeups += stats.wakeups;
+    }
+    return total;
+}
+
+/* Wait until every worker has blocked at least once and come back from it */
+static bool wait_all_blocked(void) {
+    forwarding_worker_stats_t stats;
+
+    for (uint32_t ms = 0; ms < WAIT_MS; ms++) {
+        uint32_t done = 0;
+
+        for (uint32_t w = 0; w < WORKERS; w++) {
+            assert(forwarding_get_worker_stats(w, &stats) == STATUS_SUCCESS);
+            done += stats.blocks > 0 && stats.block_ns > 0;
+        }
+        if (done == WORKERS) {
+            return true;
+        }
+        usleep(1000);
+    }
+    return false;
+}
+
+static void bring_up(port_id_t port) {
+    port_config_t config;
+    port_state_t state;
+
+    // The simulated link comes up at random once the port is enabled
+    assert(hw_sim_get_port_config(port, &config) == STATUS_SUCCESS);
+    config.admin_state = true;
+    do {
+        assert(hw_sim_set_port_config(port, &config) == STATUS_SUCCESS);
+        assert(hw_sim_get_port_state(port, &state) == STATUS_SUCCESS);
+    } while (state != PORT_STATE_UP);
+}
+
+static packet_buffer_t *make_packet(void) {
+    uint8_t frame[FRAME_LEN];
+    packet_buffer_t *packet = packet_buffer_alloc(FRAME_LEN);
+
+    memset(frame, 0, FRAME_LEN);
+    memset(frame, 0x02, 6);
+    memset(frame + 6, 0x04, 6);
+    frame[12] = 0x88;
+    frame[13] = 0xB5;
+    assert(packet != NULL);
+    assert(packet_append_data(packet, frame, FRAME_LEN) == STATUS_SUCCESS);
+    return packet;
+}
+
+/* Ones' complement sum of the big-endian words of an IPv4 header */
+static uint16_t ip_header_checksum(const uint8_t *ip) {
+    uint32_t sum = 0;
+
+    for (uint32_t i = 0; i < IP_HDR_LEN; i += 2) {
+        sum += (uint32_t)ip[i] << 8 | ip[i + 1];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+/* An IPv4 frame addressed to the router on PORT_A, for a host behind PORT_B */
+static packet_buffer_t *make_routed_packet(void) {
+    uint8_t frame[FRAME_LEN] = {0};
+    uint8_t *ip = frame + ETH_HDR_LEN;
+    mac_addr_t router;
+    ipv4_addr_t src, dst;
+    uint16_t csum;
+    packet_buffer_t *packet = packet_buffer_alloc(FRAME_LEN);
+
+    assert(port_get_mac(PORT_A, &router) == STATUS_SUCCESS);
+    assert(inet_pton(AF_INET, "10.1.0.5", &src) == 1);
+    assert(inet_pton(AF_INET, "10.20.0.9", &dst) == 1);
+    memcpy(frame, router.addr, 6);
+    memset(frame + 6, 0x04, 6);
+    frame[12] = 0x08;
+    ip[0] = 0x45;
+    ip[3] = FRAME_LEN - ETH_HDR_LEN;
+    ip[8] = 64;
+    ip[9] = IP_PROTO_UDP;
+    memcpy(ip + 12, &src, 4);
+    memcpy(ip + 16, &dst, 4);
+    csum = ip_header_checksum(ip);
+    ip[10] = (uint8_t)(csum >> 8);
+    ip[11] = (uint8_t)csum;
+
+    assert(packet != NULL);
+    assert(packet_append_data(packet, frame, FRAME_LEN) == STATUS_SUCCESS);
+    return packet;
+}
+
+static void idle_config(forwarding_config_t *config, bool block) {
+    forwarding_get_default_config(config);
+    config->num_workers = WORKERS;
+    config->pin_workers = false;
+    config->idle_spin_polls = 16;
+    config->idle_pause_polls = 16;
+    config->idle_block = block;
+}
+
+void test_forwarding_config() {
+    forwarding_config_t config;
+    forwarding_worker_stats_t stats;
+
+    // The idle thresholds default to the build flags
+    forwarding_get_default_config(&config);
+    assert(config.idle_spin_polls == CONFIG_FWD_IDLE_SPIN_POLLS);
+    assert(config.idle_pause_polls == CONFIG_FWD_IDLE_PAUSE_POLLS);
+    assert(config.idle_block == CONFIG_FWD_IDLE_BLOCK);
+
+    assert(forwarding_get_worker_count() == 0);
+    assert(forwarding_get_worker_stats(0, &stats) == STATUS_NOT_INITIALIZED);
+    assert(forwarding_shutdown() == STATUS_NOT_INITIALIZED);
+
+    idle_config(&config, true);
+    assert(forwarding_init(&config) == STATUS_SUCCESS);
+    assert(forwarding_init(&config) == STATUS_ALREADY_INITIALIZED);
+    assert(forwarding_get_worker_count() == WORKERS);
+    assert(forwarding_get_worker_stats(WORKERS, &stats) == STATUS_INVALID_PARAMETER);
+    assert(forwarding_get_worker_stats(0, NULL) == STATUS_INVALID_PARAMETER);
+    assert(forwarding_shutdown() == STATUS_SUCCESS);
+
+    printf(TEST_PASSED, "test_forwarding_config");
+}
+
+void test_forwarding_idle_block() {
+    forwarding_config_t config;
+    forwarding_worker_stats_t stats, before;
+    packet_buffer_t *pkt = make_packet();
+    uint32_t ms;
+
+    idle_config(&config, true);
+    assert(forwarding_init(&config) == STATUS_SUCCESS);
+
+    // Idle workers spin, pause and then block, and each state is timed
+    assert(wait_all_blocked());
+    stats = total_stats();
+    assert(stats.idle_polls >= WORKERS * 32 && stats.spin_ns > 0 && stats.pause_ns > 0);
+    assert(stats.rx_packets == 0);
+
+    // A packet on a port RX ring wakes the worker that drains it
+    before = total_stats();
+    assert(hw_sim_rx_enqueue_burst(PORT_A, &pkt, 1) == 1);
+    for (ms = 0; ms < WAIT_MS; ms++) {
+        stats = total_stats();
+        if (stats.processed == 1 && stats.wakeups > before.wakeups) {
+            break;
+        }
+        usleep(1000);
+    }
+    assert(stats.rx_packets == 1 && stats.processed == 1 && stats.wakeups > before.wakeups);
+
+    // Back to blocking once the work is done
+    before = stats;
+    for (ms = 0; ms < WAIT_MS && stats.blocks <= before.blocks + WORKERS; ms++) {
+        usleep(1000);
+        stats = total_stats();
+    }
+    assert(stats.blocks > before.blocks + WORKERS);
+
+    assert(forwarding_shutdown() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_forwarding_idle_block");
+}
+
+void test_forwarding_idle_poll() {
+    forwarding_config_t config;
+    forwarding_worker_stats_t stats;
+    uint32_t ms;
+
+    // Without blocking, workers stay in pause backoff
+    idle_config(&config, false);
+    assert(forwarding_init(&config) == STATUS_SUCCESS);
+    for (ms = 0; ms < WAIT_MS; ms++) {
+        stats = total_stats();
+        if (stats.pause_ns > 0 && stats.idle_polls > 100000) {
+            break;
+        }
+        usleep(1000);
+    }
+    assert(stats.pause_ns > 0 && stats.idle_polls > 100000);
+    assert(stats.blocks == 0 && stats.block_ns == 0 && stats.wakeups == 0);
+
+    assert(forwarding_shutdown() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_forwarding_idle_poll");
+}
+
+void test_forwarding_routed() {
+    forwarding_config_t config;
+    hw_sim_ring_stats_t ring;
+    ip_addr_t prefix, next_hop;
+    mac_addr_t neighbor_mac = { .addr = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x42 } };
+    packet_buffer_t *pkt = make_routed_packet();
+    uint32_t ms;
+
+    // A route and a resolved neighbor behind PORT_B
+    memset(&prefix, 0, sizeof(prefix));
+    memset(&next_hop, 0, sizeof(next_hop));
+    prefix.type = next_hop.type = IP_TYPE_V4;
+    assert(inet_pton(AF_INET, "10.20.0.0", &prefix.addr.v4) == 1);
+    assert(inet_pton(AF_INET, "10.2.0.1", &next_hop.addr.v4) == 1);
+    assert(routing_add_route(&prefix, 16, IP_TYPE_V4, &next_hop, PORT_B, 10, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(arp_add_entry(arp_table_get_instance(), &next_hop.addr.v4, &neighbor_mac, PORT_B) == STATUS_SUCCESS);
+    assert(ip_processing_init() == STATUS_SUCCESS);
+
+    // The routing stage queues the frame on PORT_B's TX ring, and the worker owning PORT_B sends it
+    idle_config(&config, true);
+    assert(forwarding_init(&config) == STATUS_SUCCESS);
+    assert(hw_sim_rx_enqueue_burst(PORT_A, &pkt, 1) == 1);
+    for (ms = 0; ms < WAIT_MS; ms++) {
+        assert(hw_sim_get_ring_stats(PORT_B, &ring) == STATUS_SUCCESS);
+        if (ring.tx_dequeued == 1) {
+            break;
+        }
+        usleep(1000);
+    }
+    assert(ring.tx_enqueued == 1 && ring.tx_dequeued == 1 && ring.tx_occupancy == 0);
+
+    assert(forwarding_shutdown() == STATUS_SUCCESS);
+    assert(ip_processing_shutdown() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_forwarding_routed");
+}
+
+int main() {
+    printf("Running forwarding unit tests...\n");
+
+    assert(packet_init() == STATUS_SUCCESS);
+    assert(hw_sim_init() == STATUS_SUCCESS);
+    bring_up(PORT_A);
+    bring_up(PORT_B);
+    assert(hw_resources_init() == STATUS_SUCCESS);
+    assert(routing_table_init(&g_table) == STATUS_SUCCESS);
+    assert(arp_init(arp_table_get_instance()) == STATUS_SUCCESS);
+
+    test_forwarding_config();
+    test_forwarding_idle_block();
+    test_forwarding_idle_poll();
+    test_forwarding_routed();
+
+    assert(routing_table_cleanup() == STATUS_SUCCESS);
+    assert(hw_sim_shutdown() == STATUS_SUCCESS);
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All forwarding tests completed successfully.\n");
+    return 0;
+}
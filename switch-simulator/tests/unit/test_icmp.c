@@ -0,0 +1,151 @@
+/**
+ * @file test_icmp.c
+ * @brief Unit tests for ICMP error generation
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <arpa/inet.h>
+#include "../../include/l3/icmp.h"
+#include "../../include/l3/ip.h"
+#include "../../include/hal/packet.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+/* ip_processing.c registers its counters with the stats collector, which
+ * is not part of the test library yet */
+status_t stats_register_counter(const char *counter_name, uint64_t *counter_ptr) {
+    (void)counter_name;
+    (void)counter_ptr;
+    return STATUS_SUCCESS;
+}
+
+static packet_buffer_t *make_datagram(uint32_t src, uint8_t protocol, uint16_t frag, uint8_t icmp_type) {
+    uint8_t datagram[48] = {0};
+    ipv4_header_t *ip = (ipv4_header_t *)datagram;
+    packet_buffer_t *pkt = packet_buffer_alloc(128);
+
+    ip->version_ihl = 0x45;
+    ip->total_length = htons(sizeof(datagram));
+    ip->flags_fragment_offset = htons(frag);
+    ip->ttl = 1;
+    ip->protocol = protocol;
+    ip->src_addr = htonl(src);
+    ip->dst_addr = htonl(0xC0A80101);
+    datagram[sizeof(ipv4_header_t)] = icmp_type;
+
+    assert(pkt != NULL);
+    assert(packet_append_data(pkt, datagram, sizeof(datagram)) == STATUS_SUCCESS);
+    return pkt;
+}
+
+static icmp_stats_t get_stats(void) {
+    icmp_stats_t stats;
+
+    assert(icmp_get_stats(&stats) == STATUS_SUCCESS);
+    return stats;
+}
+
+void test_icmp_suppression() {
+    packet_buffer_t *icmp_error = make_datagram(0x0A000001, IP_PROTO_ICMP, 0, ICMP_TYPE_DEST_UNREACH);
+    packet_buffer_t *echo = make_datagram(0x0A000001, IP_PROTO_ICMP, 0, 8);
+    packet_buffer_t *fragment = make_datagram(0x0A000001, IP_PROTO_UDP, 185, 0);
+    packet_buffer_t *loopback = make_datagram(0x7F000001, IP_PROTO_UDP, 0, 0);
+
+    assert(icmp_init() == STATUS_SUCCESS);
+
+    // Errors about errors, later fragments and unusable sources get nothing
+    assert(icmp_send_error(icmp_error, 0, ICMP_TYPE_TIME_EXCEEDED, ICMP_CODE_TTL_EXCEEDED, 0) != STATUS_SUCCESS);
+    assert(icmp_send_error(fragment, 0, ICMP_TYPE_TIME_EXCEEDED, ICMP_CODE_TTL_EXCEEDED, 0) != STATUS_SUCCESS);
+    assert(icmp_send_error(loopback, 0, ICMP_TYPE_TIME_EXCEEDED, ICMP_CODE_TTL_EXCEEDED, 0) != STATUS_SUCCESS);
+    assert(get_stats().errors_suppressed == 3);
+
+    // An echo request is answered like any other datagram
+    assert(icmp_send_error(echo, 0, ICMP_TYPE_TIME_EXCEEDED, ICMP_CODE_TTL_EXCEEDED, 0) == STATUS_SUCCESS);
+    assert(get_stats().errors_queued == 1);
+
+    // Out of range offsets are refused
+    assert(icmp_send_error(echo, 200, ICMP_TYPE_TIME_EXCEEDED, ICMP_CODE_TTL_EXCEEDED, 0) == ERROR_INVALID_PACKET);
+
+    assert(icmp_shutdown() == STATUS_SUCCESS);
+    packet_buffer_free(icmp_error);
+    packet_buffer_free(echo);
+    packet_buffer_free(fragment);
+    packet_buffer_free(loopback);
+    printf(TEST_PASSED, "test_icmp_suppression");
+}
+
+void test_icmp_rate_limit() {
+    packet_buffer_t *noisy = make_datagram(0x0A000001, IP_PROTO_UDP, 0, 0);
+    packet_buffer_t *quiet = make_datagram(0x0A000002, IP_PROTO_UDP, 0, 0);
+    uint32_t i;
+
+    assert(icmp_init() == STATUS_SUCCESS);
+    assert(icmp_set_rate_limit(1, 0) == ERROR_INVALID_PARAMETER);
+    assert(icmp_set_rate_limit(1, 3) == STATUS_SUCCESS);
+
+    // A burst worth of errors, then the source is held to its rate
+    for (i = 0; i < 3; i++) {
+        assert(icmp_send_error(noisy, 0, ICMP_TYPE_DEST_UNREACH, ICMP_CODE_HOST_UNREACH, 0) == STATUS_SUCCESS);
+    }
+    assert(icmp_send_error(noisy, 0, ICMP_TYPE_DEST_UNREACH, ICMP_CODE_HOST_UNREACH, 0) == ERROR_ICMP_RATE_LIMITED);
+
+    // Another source has its own budget
+    assert(icmp_send_error(quiet, 0, ICMP_TYPE_DEST_UNREACH, ICMP_CODE_HOST_UNREACH, 0) == STATUS_SUCCESS);
+    assert(get_stats().errors_rate_limited == 1);
+    assert(get_stats().errors_queued == 4);
+
+    // A zero rate turns errors off
+    assert(icmp_set_rate_limit(0, 1) == STATUS_SUCCESS);
+    assert(icmp_send_error(quiet, 0, ICMP_TYPE_DEST_UNREACH, ICMP_CODE_HOST_UNREACH, 0) == ERROR_ICMP_RATE_LIMITED);
+
+    assert(icmp_shutdown() == STATUS_SUCCESS);
+    packet_buffer_free(noisy);
+    packet_buffer_free(quiet);
+    printf(TEST_PASSED, "test_icmp_rate_limit");
+}
+
+void test_icmp_process_errors() {
+    packet_buffer_t *pkt = make_datagram(0x0A000001, IP_PROTO_UDP, 0, 0);
+    icmp_stats_t stats;
+    uint32_t i;
+
+    assert(icmp_init() == STATUS_SUCCESS);
+    assert(icmp_set_rate_limit(1000, 100) == STATUS_SUCCESS);
+
+    for (i = 0; i < 10; i++) {
+        assert(icmp_send_error(pkt, 0, ICMP_TYPE_DEST_UNREACH, ICMP_CODE_FRAG_NEEDED, 1400) == STATUS_SUCCESS);
+    }
+
+    // The control plane drains the queue within its budget
+    assert(icmp_process_errors(4) == 4);
+    assert(icmp_process_errors(ICMP_DRAIN_BUDGET) == 6);
+    assert(icmp_process_errors(ICMP_DRAIN_BUDGET) == 0);
+
+    // Every drained message is accounted for, sent or not
+    stats = get_stats();
+    assert(stats.errors_sent + stats.errors_send_failed == 10);
+
+    assert(icmp_shutdown() == STATUS_SUCCESS);
+    packet_buffer_free(pkt);
+    printf(TEST_PASSED, "test_icmp_process_errors");
+}
+
+int main() {
+    printf("Running ICMP unit tests...\n");
+
+    assert(packet_init() == STATUS_SUCCESS);
+
+    test_icmp_suppression();
+    test_icmp_rate_limit();
+    test_icmp_process_errors();
+
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All ICMP tests completed successfully.\n");
+    return 0;
+}
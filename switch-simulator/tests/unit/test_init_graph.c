@@ -0,0 +1,179 @@
+/**
+ * @file test_init_graph.c
+ * @brief Unit tests for dependency-ordered parallel startup
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "../../include/common/init_graph.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define MAX_STEPS 16
+#define MEET_POLLS 1000
+
+/* Start and end of every step, on one counter shared by all steps */
+static uint32_t g_clock;
+static uint32_t g_started[MAX_STEPS];
+static uint32_t g_finished[MAX_STEPS];
+static uint32_t g_meeting;
+
+static void reset(void) {
+    g_clock = 0;
+    g_meeting = 0;
+    memset(g_started, 0, sizeof(g_started));
+    memset(g_finished, 0, sizeof(g_finished));
+}
+
+static status_t record_step(void *arg) {
+    uintptr_t i = (uintptr_t)arg;
+
+    g_started[i] = __atomic_add_fetch(&g_clock, 1, __ATOMIC_ACQ_REL);
+    usleep(1000);
+    g_finished[i] = __atomic_add_fetch(&g_clock, 1, __ATOMIC_ACQ_REL);
+    return STATUS_SUCCESS;
+}
+
+/* Succeeds only if another step arrives while this one waits */
+static status_t meet_step(void *arg) {
+    (void)arg;
+
+    __atomic_add_fetch(&g_meeting, 1, __ATOMIC_ACQ_REL);
+    for (int i = 0; i < MEET_POLLS; i++) {
+        if (__atomic_load_n(&g_meeting, __ATOMIC_ACQUIRE) >= 2) {
+            return STATUS_SUCCESS;
+        }
+        usleep(1000);
+    }
+    return STATUS_TIMEOUT;
+}
+
+static status_t fail_step(void *arg) {
+    record_step(arg);
+    return STATUS_NO_MEMORY;
+}
+
+#define STEP(n, after) { #n, record_step, (void *)(uintptr_t)(n), (after) }
+
+void test_init_graph_invalid() {
+    init_step_t steps[2] = { STEP(0, 0), STEP(1, INIT_AFTER(0)) };
+    init_step_t many[INIT_GRAPH_MAX_STEPS + 1];
+
+    assert(init_graph_run(NULL, 1, 1, NULL) == STATUS_INVALID_PARAMETER);
+    assert(init_graph_run(steps, 0, 1, NULL) == STATUS_INVALID_PARAMETER);
+    memset(many, 0, sizeof(many));
+    assert(init_graph_run(many, INIT_GRAPH_MAX_STEPS + 1, 1, NULL) == STATUS_INVALID_PARAMETER);
+
+    // A step may only need steps before it
+    steps[0].after = INIT_AFTER(1);
+    assert(init_graph_run(steps, 2, 1, NULL) == STATUS_INVALID_PARAMETER);
+    steps[0].after = INIT_AFTER(0);
+    assert(init_graph_run(steps, 2, 1, NULL) == STATUS_INVALID_PARAMETER);
+    steps[0].after = 0;
+    steps[1].fn = NULL;
+    assert(init_graph_run(steps, 2, 1, NULL) == STATUS_INVALID_PARAMETER);
+
+    printf(TEST_PASSED, "test_init_graph_invalid");
+}
+
+void test_init_graph_order() {
+    // 0 and 1 stand alone, 2 needs 0, 3 needs 1 and 2, 4 and 5 need 3
+    const init_step_t steps[6] = {
+        STEP(0, 0),
+        STEP(1, 0),
+        STEP(2, INIT_AFTER(0)),
+        STEP(3, INIT_AFTER(1) | INIT_AFTER(2)),
+        STEP(4, INIT_AFTER(3)),
+        STEP(5, INIT_AFTER(3)),
+    };
+    init_step_result_t results[6];
+
+    // One thread runs the steps in array order
+    reset();
+    assert(init_graph_run(steps, 6, 1, results) == STATUS_SUCCESS);
+    for (uint32_t i = 0; i < 6; i++) {
+        assert(g_started[i] == 2 * i + 1 && g_finished[i] == 2 * i + 2);
+        assert(results[i].status == STATUS_SUCCESS && results[i].elapsed_ns >= 1000000);
+    }
+
+    // Several threads never start a step before what it needs is done
+    for (uint32_t threads = 0; threads <= 4; threads += 2) {
+        reset();
+        assert(init_graph_run(steps, 6, threads, results) == STATUS_SUCCESS);
+        for (uint32_t i = 0; i < 6; i++) {
+            assert(results[i].status == STATUS_SUCCESS);
+            for (uint32_t d = 0; d < i; d++) {
+                if (steps[i].after & INIT_AFTER(d)) {
+                    assert(g_finished[d] < g_started[i]);
+                }
+            }
+        }
+    }
+
+    printf(TEST_PASSED, "test_init_graph_order");
+}
+
+void test_init_graph_parallel() {
+    const init_step_t steps[3] = {
+        { "meet-a", meet_step, NULL, 0 },
+        { "meet-b", meet_step, NULL, 0 },
+        STEP(2, INIT_AFTER(0) | INIT_AFTER(1)),
+    };
+    init_step_result_t results[3];
+
+    // Independent steps run at the same time
+    reset();
+    assert(init_graph_run(steps, 3, 2, results) == STATUS_SUCCESS);
+    assert(results[0].status == STATUS_SUCCESS && results[1].status == STATUS_SUCCESS);
+    assert(g_finished[2] != 0);
+
+    // One thread cannot bring them together
+    reset();
+    assert(init_graph_run(steps, 3, 1, results) == STATUS_TIMEOUT);
+    assert(results[0].status == STATUS_TIMEOUT);
+    assert(results[1].status == STATUS_NOT_EXECUTED && results[2].status == STATUS_NOT_EXECUTED);
+
+    printf(TEST_PASSED, "test_init_graph_parallel");
+}
+
+void test_init_graph_failure() {
+    const init_step_t steps[4] = {
+        STEP(0, 0),
+        { "fails", fail_step, (void *)(uintptr_t)1, INIT_AFTER(0) },
+        STEP(2, INIT_AFTER(1)),
+        STEP(3, INIT_AFTER(1)),
+    };
+    init_step_result_t results[4];
+
+    // After a failure nothing more is started; its status is returned
+    for (uint32_t threads = 1; threads <= 4; threads += 3) {
+        reset();
+        assert(init_graph_run(steps, 4, threads, results) == STATUS_NO_MEMORY);
+        assert(results[0].status == STATUS_SUCCESS);
+        assert(results[1].status == STATUS_NO_MEMORY && results[1].elapsed_ns > 0);
+        assert(results[2].status == STATUS_NOT_EXECUTED && results[3].status == STATUS_NOT_EXECUTED);
+        assert(g_started[2] == 0 && g_started[3] == 0);
+    }
+
+    // Results are optional
+    assert(init_graph_run(steps, 4, 2, NULL) == STATUS_NO_MEMORY);
+
+    printf(TEST_PASSED, "test_init_graph_failure");
+}
+
+int main() {
+    printf("Running init graph unit tests...\n");
+
+    test_init_graph_invalid();
+    test_init_graph_order();
+    test_init_graph_parallel();
+    test_init_graph_failure();
+
+    printf("All init graph tests completed successfully.\n");
+    return 0;
+}
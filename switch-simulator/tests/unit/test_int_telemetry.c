@@ -0,0 +1,321 @@
+/**
+ * @file test_int_telemetry.c
+ * @brief Unit tests for in-band network telemetry stamping
+ *
+ * A path of switches is played by one process: each hop configures the
+ * switch ID, takes the packet in as a port would and sends it out, and
+ * the frame crosses the wire as a fresh, freshly parsed copy of its
+ * bytes. The ACL choosing the flow is stood in for by setting the
+ * packet's role after it is received.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/hal/int_telemetry.h"
+#include "../../include/hal/packet_offload.h"
+#include "../../include/hal/packet.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define ETH_LEN 14
+#define IP_LEN 20
+#define TCP_LEN 20
+#define UDP_LEN 8
+#define PAYLOAD_LEN 100
+#define DSCP_EF 46
+#define MTU 1514
+
+static uint8_t g_frame[ETH_LEN + IP_LEN + TCP_LEN + PAYLOAD_LEN];
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static uint16_t get16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+
+/* Ethernet, IPv4 with DSCP EF, then TCP or UDP; returns the length */
+static uint32_t build_frame(uint8_t proto) {
+    uint32_t l4_hdr = proto == 6 ? TCP_LEN : UDP_LEN;
+    uint8_t *ip = g_frame + ETH_LEN;
+    uint8_t *th = ip + IP_LEN;
+
+    memset(g_frame, 0, sizeof(g_frame));
+    memset(g_frame, 0x02, 6);
+    memset(g_frame + 6, 0x04, 6);
+    put16(g_frame + 12, 0x0800);
+    ip[0] = 0x45;
+    ip[1] = DSCP_EF << 2 | 0x01;
+    put16(ip + 2, (uint16_t)(IP_LEN + l4_hdr + PAYLOAD_LEN));
+    ip[8] = 64;
+    ip[9] = proto;
+    put16(ip + 12, 0x0A00);
+    put16(ip + 14, 0x0001);
+    put16(ip + 16, 0xC0A8);
+    put16(ip + 18, 0x0001);
+    put16(th, 40000);
+    put16(th + 2, 80);
+    if (proto == 6) {
+        th[12] = (TCP_LEN / 4) << 4;
+        th[13] = 0x10;
+    } else {
+        put16(th + 4, (uint16_t)(UDP_LEN + PAYLOAD_LEN));
+    }
+    for (uint32_t i = 0; i < PAYLOAD_LEN; i++) {
+        th[l4_hdr + i] = (uint8_t)(i * 7 + 1);
+    }
+    return ETH_LEN + IP_LEN + l4_hdr + PAYLOAD_LEN;
+}
+
+/* A parsed packet of bytes as they arrive on a port */
+static packet_buffer_t *receive(const uint8_t *bytes, uint32_t len) {
+    packet_buffer_t *pkt = packet_buffer_alloc(len);
+
+    assert(pkt != NULL);
+    assert(packet_append_data(pkt, bytes, len) == STATUS_SUCCESS);
+    assert(packet_parse(pkt) == STATUS_SUCCESS);
+    return pkt;
+}
+
+/* The frame with both checksums filled in */
+static packet_buffer_t *make_packet(uint8_t proto) {
+    packet_buffer_t *pkt = receive(g_frame, build_frame(proto));
+
+    pkt->metadata.offload = PACKET_OFFLOAD_IP_CSUM | PACKET_OFFLOAD_L4_CSUM;
+    assert(packet_offload_resolve(pkt, 0) == STATUS_SUCCESS);
+    pkt->metadata.offload = 0;
+    return pkt;
+}
+
+/* Send the packet over a wire: the next switch gets a copy of its bytes */
+static packet_buffer_t *wire(packet_buffer_t *pkt, uint8_t *bytes, uint32_t *len) {
+    *len = packet_chain_length(pkt);
+    assert(packet_copy_data(pkt, 0, bytes, *len) == STATUS_SUCCESS);
+    packet_buffer_free(pkt);
+    return receive(bytes, *len);
+}
+
+/* Take a packet in and send it out as switch switch_id; returns what the switch sent */
+static packet_buffer_t *hop(packet_buffer_t *pkt, uint32_t switch_id, port_id_t in, port_id_t out,
+                            bool source, uint32_t depth) {
+    int_telemetry_config_t config = { .enabled = true, .switch_id = switch_id, .max_hops = 0 };
+
+    assert(int_telemetry_configure(&config) == STATUS_SUCCESS);
+    pkt->metadata.port = in;
+    int_telemetry_rx_burst(&pkt, 1);
+    if (source) {
+        pkt->metadata.int_watch = INT_WATCH_SOURCE;
+    }
+    int_telemetry_note_queue(pkt, 3, depth);
+    int_telemetry_egress_burst(out, MTU, &pkt, 1);
+    assert(pkt->metadata.int_watch == INT_WATCH_NONE);
+    return pkt;
+}
+
+static bool checksums_good(packet_buffer_t *pkt) {
+    packet_offload_rx(pkt);
+    return (pkt->metadata.offload & PACKET_OFFLOAD_RX_MASK) ==
+           (PACKET_OFFLOAD_RX_IP_GOOD | PACKET_OFFLOAD_RX_L4_GOOD);
+}
+
+static bool find_hop(uint32_t switch_id, port_id_t port, int_telemetry_hop_stats_t *stats) {
+    for (uint32_t slot = 0; slot < CONFIG_INT_SINK_SLOTS; slot++) {
+        if (int_telemetry_get_hop(slot, stats) == STATUS_SUCCESS &&
+            stats->switch_id == switch_id && stats->egress_port == port) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void test_int_config() {
+    int_telemetry_config_t config = { .enabled = true, .switch_id = 7, .max_hops = 0 };
+    int_telemetry_hop_stats_t hop_stats;
+    int_telemetry_stats_t stats;
+
+    // Nothing works before the hardware simulation sets the module up
+    assert(int_telemetry_configure(&config) == STATUS_NOT_INITIALIZED);
+    assert(int_telemetry_set_sink(1, true) == STATUS_NOT_INITIALIZED);
+    assert(int_telemetry_get_stats(&stats) == STATUS_NOT_INITIALIZED);
+
+    // The mode starts off, with the most hops
+    assert(int_telemetry_init() == STATUS_SUCCESS);
+    assert(!int_telemetry_enabled());
+    assert(int_telemetry_get_config(&config) == STATUS_SUCCESS);
+    assert(!config.enabled && config.max_hops == CONFIG_INT_MAX_HOPS);
+
+    config.enabled = true;
+    config.switch_id = 7;
+    config.max_hops = CONFIG_INT_MAX_HOPS + 1;
+    assert(int_telemetry_configure(&config) == STATUS_INVALID_PARAMETER);
+    assert(int_telemetry_configure(NULL) == STATUS_INVALID_PARAMETER);
+    config.max_hops = 2;
+    assert(int_telemetry_configure(&config) == STATUS_SUCCESS);
+    assert(int_telemetry_enabled());
+    memset(&config, 0, sizeof(config));
+    assert(int_telemetry_get_config(&config) == STATUS_SUCCESS);
+    assert(config.enabled && config.switch_id == 7 && config.max_hops == 2);
+
+    assert(int_telemetry_set_sink(CONFIG_MAX_PORTS, true) == STATUS_INVALID_PARAMETER);
+    assert(int_telemetry_get_hop(CONFIG_INT_SINK_SLOTS, &hop_stats) == STATUS_INVALID_PARAMETER);
+    assert(int_telemetry_get_hop(0, &hop_stats) == STATUS_NOT_FOUND);
+    assert(int_telemetry_get_stats(NULL) == STATUS_INVALID_PARAMETER);
+    assert(int_telemetry_get_stats(&stats) == STATUS_SUCCESS && stats.sourced == 0);
+
+    // Shutting down turns the mode off
+    int_telemetry_shutdown();
+    assert(!int_telemetry_enabled());
+    assert(int_telemetry_get_stats(&stats) == STATUS_NOT_INITIALIZED);
+
+    printf(TEST_PASSED, "test_int_config");
+}
+
+void test_int_path() {
+    const uint8_t protos[] = { 17, 6 };
+    uint8_t sent[sizeof(g_frame)];
+    uint8_t bytes[sizeof(g_frame) + INT_SHIM_LEN + 2 * INT_HOP_LEN];
+    int_telemetry_hop_stats_t hop_stats;
+    int_telemetry_stats_t stats;
+    packet_buffer_t *pkt;
+    uint32_t sent_len, len, end;
+    const uint8_t *shim;
+
+    assert(int_telemetry_init() == STATUS_SUCCESS);
+    assert(int_telemetry_set_sink(7, true) == STATUS_SUCCESS);
+
+    for (uint32_t p = 0; p < sizeof(protos); p++) {
+        end = ETH_LEN + IP_LEN + (protos[p] == 6 ? TCP_LEN : UDP_LEN);
+        pkt = make_packet(protos[p]);
+        sent_len = packet_chain_length(pkt);
+        assert(packet_copy_data(pkt, 0, sent, sent_len) == STATUS_SUCCESS);
+
+        // The source marks the packet and adds the shim with its record after the transport header
+        pkt = wire(hop(pkt, 11, 1, 2, true, 5), bytes, &len);
+        assert(len == sent_len + INT_SHIM_LEN + INT_HOP_LEN);
+        assert(checksums_good(pkt));
+        assert(bytes[ETH_LEN + 1] >> 2 == (DSCP_EF | INT_DSCP_MARK) && (bytes[ETH_LEN + 1] & 3) == 1);
+        assert(get16(bytes + ETH_LEN + 2) == sent_len - ETH_LEN + INT_SHIM_LEN + INT_HOP_LEN);
+        shim = bytes + end;
+        assert(shim[0] == INT_VERSION << 4 && shim[1] == 1 && shim[2] == CONFIG_INT_MAX_HOPS);
+        assert(shim[3] == DSCP_EF && get16(shim + 4) == INT_SHIM_LEN + INT_HOP_LEN);
+        assert(get32(shim + INT_SHIM_LEN) == 11);
+        assert(get16(shim + INT_SHIM_LEN + 4) == 1 && get16(shim + INT_SHIM_LEN + 6) == 2);
+        assert(get32(shim + INT_SHIM_LEN + 12) == (3u << 24 | 5));
+        assert(memcmp(bytes + end + INT_SHIM_LEN + INT_HOP_LEN, sent + end, sent_len - end) == 0);
+
+        // A transit switch knows the shim by the mark and puts its record first
+        pkt = wire(hop(pkt, 12, 5, 6, false, 9), bytes, &len);
+        assert(len == sent_len + INT_SHIM_LEN + 2 * INT_HOP_LEN);
+        assert(checksums_good(pkt));
+        assert(shim[1] == 2 && get16(shim + 4) == INT_SHIM_LEN + 2 * INT_HOP_LEN);
+        assert(get32(shim + INT_SHIM_LEN) == 12 && get16(shim + INT_SHIM_LEN + 6) == 6);
+        assert(get32(shim + INT_SHIM_LEN + INT_HOP_LEN) == 11);
+
+        // The sink hands on the packet as the source got it
+        pkt = wire(hop(pkt, 13, 8, 7, false, 0), bytes, &len);
+        assert(len == sent_len && memcmp(bytes, sent, sent_len) == 0);
+        packet_buffer_free(pkt);
+    }
+
+    // Every hop of both packets reached the sink statistics
+    assert(int_telemetry_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.sourced == 2 && stats.stamped == 2 && stats.sunk == 2 && stats.records == 6);
+    assert(stats.exceeded == 0 && stats.unsupported == 0 && stats.untracked == 0);
+    assert(find_hop(11, 2, &hop_stats) && hop_stats.packets == 2);
+    assert(hop_stats.depth_total == 10 && hop_stats.depth_max == 5);
+    assert(hop_stats.latency_total_ns >= hop_stats.latency_max_ns && hop_stats.latency_max_ns < 1000000000ull);
+    assert(find_hop(12, 6, &hop_stats) && hop_stats.packets == 2 && hop_stats.depth_max == 9);
+    assert(find_hop(13, 7, &hop_stats) && hop_stats.packets == 2 && hop_stats.depth_total == 0);
+    assert(!find_hop(11, 1, &hop_stats));
+
+    int_telemetry_shutdown();
+    printf(TEST_PASSED, "test_int_path");
+}
+
+void test_int_limits() {
+    int_telemetry_config_t config = { .enabled = true, .switch_id = 21, .max_hops = 1 };
+    uint8_t sent[sizeof(g_frame)];
+    uint8_t bytes[sizeof(g_frame) + INT_SHIM_LEN + INT_HOP_LEN];
+    uint32_t end = ETH_LEN + IP_LEN + UDP_LEN;
+    int_telemetry_stats_t stats;
+    packet_buffer_t *pkt;
+    uint32_t sent_len, len;
+
+    assert(int_telemetry_init() == STATUS_SUCCESS);
+    assert(int_telemetry_set_sink(9, true) == STATUS_SUCCESS);
+
+    // Unwatched packets are left alone
+    pkt = make_packet(17);
+    sent_len = packet_chain_length(pkt);
+    assert(packet_copy_data(pkt, 0, sent, sent_len) == STATUS_SUCCESS);
+    pkt = wire(hop(pkt, 20, 1, 2, false, 0), bytes, &len);
+    assert(len == sent_len && memcmp(bytes, sent, sent_len) == 0);
+
+    // A shim with room for one hop flags the next one instead of growing
+    assert(int_telemetry_configure(&config) == STATUS_SUCCESS);
+    pkt->metadata.port = 1;
+    int_telemetry_rx_burst(&pkt, 1);
+    pkt->metadata.int_watch = INT_WATCH_SOURCE;
+    int_telemetry_egress_burst(2, MTU, &pkt, 1);
+    pkt = wire(pkt, bytes, &len);
+    assert(len == sent_len + INT_SHIM_LEN + INT_HOP_LEN && bytes[end + 2] == 1);
+    pkt = wire(hop(pkt, 22, 3, 4, false, 0), bytes, &len);
+    assert(len == sent_len + INT_SHIM_LEN + INT_HOP_LEN && checksums_good(pkt));
+    assert((bytes[end] & INT_SHIM_F_EXCEEDED) && bytes[end + 1] == 1 && get16(bytes + end + 6) == 1);
+    packet_buffer_free(pkt);
+
+    // A hop that would grow the packet past the MTU skips its record
+    pkt = make_packet(17);
+    int_telemetry_rx_burst(&pkt, 1);
+    pkt->metadata.int_watch = INT_WATCH_SOURCE;
+    int_telemetry_egress_burst(2, sent_len + INT_SHIM_LEN + INT_HOP_LEN - 1, &pkt, 1);
+    assert(packet_chain_length(pkt) == sent_len);
+    packet_buffer_free(pkt);
+
+    // A source that is also the sink feeds its record without a shim
+    pkt = make_packet(17);
+    pkt = wire(hop(pkt, 23, 1, 9, true, 4), bytes, &len);
+    assert(len == sent_len && memcmp(bytes, sent, sent_len) == 0);
+    packet_buffer_free(pkt);
+
+    // Frames that cannot be stamped are counted
+    pkt = make_packet(17);
+    pkt->metadata.offload = PACKET_OFFLOAD_TSO;
+    int_telemetry_rx_burst(&pkt, 1);
+    pkt->metadata.int_watch = INT_WATCH_SOURCE;
+    int_telemetry_egress_burst(2, MTU, &pkt, 1);
+    assert(packet_chain_length(pkt) == sent_len);
+    packet_buffer_free(pkt);
+
+    assert(int_telemetry_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.sourced == 1 && stats.stamped == 0 && stats.exceeded == 1);
+    assert(stats.mtu_skipped == 1 && stats.unsupported == 1 && stats.records == 1);
+
+    int_telemetry_shutdown();
+    printf(TEST_PASSED, "test_int_limits");
+}
+
+int main() {
+    printf("Running INT telemetry unit tests...\n");
+
+    assert(packet_init() == STATUS_SUCCESS);
+
+    test_int_config();
+    test_int_path();
+    test_int_limits();
+
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All INT telemetry tests completed successfully.\n");
+    return 0;
+}
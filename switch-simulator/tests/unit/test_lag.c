@@ -0,0 +1,307 @@
+/**
+ * @file test_lag.c
+ * @brief Unit tests for link aggregation and LACP
+ *
+ * The LAGs live on switch instances other than the process's own, whose
+ * member links start up without the port layer. Two instances wired
+ * back to back negotiate LACP with each other.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/l2/lag.h"
+#include "../../include/hal/packet.h"
+#include "../../include/hal/port_types.h"
+#include "../../include/common/switch_context.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define LOCAL 1
+#define REMOTE 2
+#define MEMBERS 4
+#define FLOWS 256
+#define WIRE_MAX 64
+
+/* LACPDUs sent by one instance, delivered to the other on the same port */
+typedef struct {
+    uint32_t count;
+    port_id_t ports[WIRE_MAX];
+    packet_buffer_t *packets[WIRE_MAX];
+} wire_t;
+
+static void wire_transmit(port_id_t port_id, packet_buffer_t *packet, void *arg) {
+    wire_t *wire = arg;
+
+    assert(wire->count < WIRE_MAX);
+    assert(lag_is_lacpdu(packet) && packet->metadata.port == port_id);
+    wire->ports[wire->count] = port_id;
+    wire->packets[wire->count++] = packet;
+}
+
+static void wire_deliver(wire_t *wire, uint32_t instance, uint64_t now_ms) {
+    assert(switch_context_bind(instance) == STATUS_SUCCESS);
+    for (uint32_t i = 0; i < wire->count; i++) {
+        assert(lag_receive_lacpdu(wire->ports[i], wire->packets[i], now_ms) == STATUS_SUCCESS);
+        packet_buffer_free(wire->packets[i]);
+    }
+    wire->count = 0;
+}
+
+/* Timers run on both instances, then each gets what the other sent */
+static void exchange(uint64_t now_ms, bool remote_alive) {
+    wire_t to_remote = { 0 }, to_local = { 0 };
+
+    assert(switch_context_bind(LOCAL) == STATUS_SUCCESS);
+    lag_process_timers(now_ms, wire_transmit, &to_remote);
+    assert(switch_context_bind(REMOTE) == STATUS_SUCCESS);
+    lag_process_timers(now_ms, wire_transmit, &to_local);
+
+    wire_deliver(&to_remote, REMOTE, now_ms);
+    if (remote_alive) {
+        wire_deliver(&to_local, LOCAL, now_ms);
+    } else {
+        for (uint32_t i = 0; i < to_local.count; i++) {
+            packet_buffer_free(to_local.packets[i]);
+        }
+    }
+    assert(switch_context_bind(LOCAL) == STATUS_SUCCESS);
+}
+
+static uint32_t active_members(port_id_t lag_port) {
+    lag_info_t info;
+
+    assert(lag_get_info(lag_port, &info) == STATUS_SUCCESS);
+    return info.active_count;
+}
+
+/* Parsed UDP datagram of one flow, told apart by its source port */
+static packet_buffer_t *make_flow(uint16_t flow) {
+    static const uint8_t header[] = {
+        0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x08, 0x00,
+        0x45, 0x00, 0x00, 0x1c, 0x00, 0x00, 0x40, 0x00, 0x40, 0x11, 0x00, 0x00,
+        10, 0, 0, 1, 10, 0, 0, 2,
+        0x00, 0x00, 0x00, 0x35, 0x00, 0x08, 0x00, 0x00,
+    };
+    packet_buffer_t *packet = packet_buffer_alloc(sizeof(header));
+
+    assert(packet != NULL);
+    assert(packet_append_data(packet, header, sizeof(header)) == STATUS_SUCCESS);
+    packet->data[34] = (uint8_t)(flow >> 8);
+    packet->data[35] = (uint8_t)flow;
+    assert(packet_parse(packet) == STATUS_SUCCESS);
+    return packet;
+}
+
+void test_lag_members() {
+    port_id_t lag_port = LAG_PORT_ID(0);
+    lag_config_t config;
+    lag_info_t info;
+
+    assert(switch_context_bind(LOCAL) == STATUS_SUCCESS);
+    assert(lag_create(lag_port, NULL) == STATUS_NOT_INITIALIZED);
+    assert(lag_init() == STATUS_SUCCESS);
+    assert(lag_init() == STATUS_ALREADY_INITIALIZED);
+
+    lag_get_default_config(&config);
+    assert(config.mode == LAG_MODE_LACP_ACTIVE && config.hash == LAG_HASH_L3_L4 && !config.lacp_fast);
+
+    // Only LAG port IDs name LAGs
+    assert(lag_create(5, NULL) == STATUS_INVALID_PARAMETER);
+    assert(lag_create(lag_port, NULL) == STATUS_SUCCESS);
+    assert(lag_create(lag_port, NULL) == STATUS_ALREADY_EXISTS);
+    assert(lag_add_member(LAG_PORT_ID(1), 1) == STATUS_NOT_FOUND);
+    assert(lag_add_member(lag_port, lag_port) == STATUS_INVALID_PARAMETER);
+
+    // A port belongs to one LAG at most
+    assert(lag_create(LAG_PORT_ID(1), NULL) == STATUS_SUCCESS);
+    assert(lag_add_member(lag_port, 1) == STATUS_SUCCESS);
+    assert(lag_add_member(lag_port, 1) == STATUS_RESOURCE_BUSY);
+    assert(lag_add_member(LAG_PORT_ID(1), 1) == STATUS_RESOURCE_BUSY);
+    for (port_id_t p = 2; p <= CONFIG_LAG_MAX_MEMBERS; p++) {
+        assert(lag_add_member(lag_port, p) == STATUS_SUCCESS);
+    }
+    assert(lag_add_member(lag_port, CONFIG_LAG_MAX_MEMBERS + 1) == STATUS_RESOURCE_EXHAUSTED);
+
+    // Without a partner an LACP member takes no traffic
+    assert(lag_get_info(lag_port, &info) == STATUS_SUCCESS);
+    assert(info.member_count == CONFIG_LAG_MAX_MEMBERS && info.active_count == 0 && info.key == 1);
+    assert(info.members[0].link_up && !info.members[0].selected);
+    assert(info.members[0].actor_state & LACP_STATE_DEFAULTED);
+    assert(lag_ingress_port(1) == PORT_ID_INVALID);
+
+    assert(lag_remove_member(lag_port, 1) == STATUS_SUCCESS);
+    assert(lag_remove_member(lag_port, 1) == STATUS_NOT_FOUND);
+    assert(lag_ingress_port(1) == 1);
+    assert(lag_set_member_link(1, false) == STATUS_NOT_FOUND);
+
+    assert(lag_delete(lag_port) == STATUS_SUCCESS);
+    assert(lag_delete(lag_port) == STATUS_NOT_FOUND);
+    assert(lag_delete(LAG_PORT_ID(1)) == STATUS_SUCCESS);
+    assert(lag_get_info(lag_port, &info) == STATUS_NOT_FOUND);
+    assert(lag_ingress_port(2) == 2);
+
+    printf(TEST_PASSED, "test_lag_members");
+}
+
+void test_lag_static_distribution() {
+    lag_config_t config = { .mode = LAG_MODE_STATIC, .hash = LAG_HASH_L3_L4 };
+    port_id_t lag_port = LAG_PORT_ID(2);
+    uint32_t hits[MEMBERS + 1] = { 0 };
+    port_id_t chosen[FLOWS];
+    packet_buffer_t *packet;
+
+    assert(lag_create(lag_port, &config) == STATUS_SUCCESS);
+    for (port_id_t p = 1; p <= MEMBERS; p++) {
+        assert(lag_add_member(lag_port, p) == STATUS_SUCCESS);
+    }
+    assert(active_members(lag_port) == MEMBERS);
+
+    // Members receive for the LAG and send only for it
+    assert(lag_ingress_port(1) == lag_port);
+    assert(lag_ingress_port(MEMBERS + 1) == MEMBERS + 1);
+    packet = make_flow(0);
+    assert(lag_egress_port(1, packet) == PORT_ID_INVALID);
+    assert(lag_egress_port(MEMBERS + 1, packet) == MEMBERS + 1);
+    assert(lag_egress_port(LAG_PORT_ID(3), packet) == PORT_ID_INVALID);
+    packet_buffer_free(packet);
+
+    // Every flow stays on one member, and every member gets flows
+    for (uint16_t f = 0; f < FLOWS; f++) {
+        packet = make_flow(f);
+        chosen[f] = lag_egress_port(lag_port, packet);
+        assert(chosen[f] >= 1 && chosen[f] <= MEMBERS);
+        assert(lag_egress_port(lag_port, packet) == chosen[f]);
+        hits[chosen[f]]++;
+        packet_buffer_free(packet);
+    }
+    for (port_id_t p = 1; p <= MEMBERS; p++) {
+        assert(hits[p] > FLOWS / MEMBERS / 4);
+    }
+
+    // An L2 hash puts every flow between two hosts on one member
+    config.hash = LAG_HASH_L2;
+    assert(lag_set_config(lag_port, &config) == STATUS_SUCCESS);
+    packet = make_flow(0);
+    port_id_t l2_member = lag_egress_port(lag_port, packet);
+    packet_buffer_free(packet);
+    for (uint16_t f = 1; f < FLOWS; f++) {
+        packet = make_flow(f);
+        assert(lag_egress_port(lag_port, packet) == l2_member);
+        packet_buffer_free(packet);
+    }
+    config.hash = LAG_HASH_L3_L4;
+    assert(lag_set_config(lag_port, &config) == STATUS_SUCCESS);
+
+    // A member going down stops taking traffic at once
+    assert(lag_set_member_link(2, false) == STATUS_SUCCESS);
+    assert(active_members(lag_port) == MEMBERS - 1);
+    assert(lag_ingress_port(2) == PORT_ID_INVALID);
+    for (uint16_t f = 0; f < FLOWS; f++) {
+        packet = make_flow(f);
+        port_id_t out = lag_egress_port(lag_port, packet);
+        assert(out >= 1 && out <= MEMBERS && out != 2);
+        packet_buffer_free(packet);
+    }
+
+    // With no member up the LAG drops
+    for (port_id_t p = 1; p <= MEMBERS; p++) {
+        assert(lag_set_member_link(p, false) == STATUS_SUCCESS);
+    }
+    packet = make_flow(0);
+    assert(lag_egress_port(lag_port, packet) == PORT_ID_INVALID);
+    assert(lag_set_member_link(1, true) == STATUS_SUCCESS);
+    assert(lag_egress_port(lag_port, packet) == 1);
+    packet_buffer_free(packet);
+
+    assert(lag_delete(lag_port) == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_lag_static_distribution");
+}
+
+void test_lag_lacp() {
+    lag_config_t config;
+    port_id_t lag_port = LAG_PORT_ID(0);
+    mac_addr_t remote_system = { .addr = { 0x02, 0, 0, 0, 0, 0x99 } };
+    lag_info_t info;
+    uint64_t now = 0;
+
+    lag_get_default_config(&config);
+    config.lacp_fast = true;
+
+    // Two members on each side, wired port to port
+    assert(lag_create(lag_port, &config) == STATUS_SUCCESS);
+    assert(lag_add_member(lag_port, 1) == STATUS_SUCCESS);
+    assert(lag_add_member(lag_port, 2) == STATUS_SUCCESS);
+    assert(switch_context_bind(REMOTE) == STATUS_SUCCESS);
+    assert(lag_init() == STATUS_SUCCESS);
+    assert(lag_set_system(&remote_system, 100) == STATUS_SUCCESS);
+    config.mode = LAG_MODE_LACP_PASSIVE;
+    assert(lag_create(lag_port, &config) == STATUS_SUCCESS);
+    assert(lag_add_member(lag_port, 1) == STATUS_SUCCESS);
+    assert(lag_add_member(lag_port, 2) == STATUS_SUCCESS);
+    assert(switch_context_bind(LOCAL) == STATUS_SUCCESS);
+
+    // Active and passive ends agree within a few exchanges
+    for (int i = 0; i < 4; i++) {
+        exchange(now, true);
+    }
+    assert(active_members(lag_port) == 2);
+    assert(lag_ingress_port(1) == lag_port);
+    assert(lag_get_info(lag_port, &info) == STATUS_SUCCESS);
+    assert(info.members[0].partner_system_priority == 100);
+    assert(memcmp(info.members[0].partner_system.addr, remote_system.addr, MAC_ADDR_LEN) == 0);
+    assert(info.members[0].partner_key == 1 && info.members[0].partner_port == 2);
+    assert(info.members[0].actor_state & LACP_STATE_DISTRIBUTING);
+    assert(!(info.members[0].actor_state & LACP_STATE_DEFAULTED));
+    assert(info.members[0].lacpdus_rx > 0 && info.members[0].lacpdus_tx > 0);
+    assert(switch_context_bind(REMOTE) == STATUS_SUCCESS);
+    assert(active_members(lag_port) == 2);
+    assert(switch_context_bind(LOCAL) == STATUS_SUCCESS);
+
+    // A partner that falls silent times out after three fast periods
+    now += 1000;
+    exchange(now, false);
+    assert(active_members(lag_port) == 2);
+    now += 3000;
+    exchange(now, false);
+    assert(active_members(lag_port) == 0);
+    assert(lag_ingress_port(1) == PORT_ID_INVALID);
+
+    // It comes back as soon as the partner speaks again
+    now += 1000;
+    exchange(now, true);
+    exchange(now, true);
+    exchange(now, true);
+    assert(active_members(lag_port) == 2);
+
+    // Frames that are not LACPDUs are refused
+    packet_buffer_t *packet = make_flow(0);
+    assert(!lag_is_lacpdu(packet));
+    assert(lag_receive_lacpdu(1, packet, now) == STATUS_INVALID_PARAMETER);
+    packet_buffer_free(packet);
+
+    assert(switch_context_bind(REMOTE) == STATUS_SUCCESS);
+    assert(lag_deinit() == STATUS_SUCCESS);
+    assert(switch_context_bind(LOCAL) == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_lag_lacp");
+}
+
+int main() {
+    printf("Running LAG unit tests...\n");
+
+    assert(packet_init() == STATUS_SUCCESS);
+
+    test_lag_members();
+    test_lag_static_distribution();
+    test_lag_lacp();
+
+    assert(lag_deinit() == STATUS_SUCCESS);
+    assert(lag_deinit() == STATUS_NOT_INITIALIZED);
+    assert(switch_context_bind(SWITCH_INSTANCE_DEFAULT) == STATUS_SUCCESS);
+
+    printf("All LAG tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,245 @@
+/**
+ * @file test_link_event.c
+ * @brief Unit tests for coalesced and dampened link events
+ *
+ * The tests run on the virtual clock, so coalescing intervals and
+ * dampening half-lives pass as soon as the event loop has nothing to do.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/hal/link_event.h"
+#include "../../include/common/event_loop.h"
+#include "../../include/common/sim_clock.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define MS 1000ULL
+
+typedef struct {
+    uint32_t batches;
+    link_event_batch_t last;
+} batch_log_t;
+
+static batch_log_t g_log;
+
+static void record_batch(const link_event_batch_t *batch, void *arg) {
+    batch_log_t *log = (batch_log_t *)arg;
+
+    log->batches++;
+    log->last = *batch;
+}
+
+static void ignore_batch(const link_event_batch_t *batch, void *arg) {
+    (void)batch;
+    (void)arg;
+}
+
+static void stop_loop(event_timer_t *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+    event_loop_stop();
+}
+
+static void run_for(uint64_t ms) {
+    event_timer_t stop;
+
+    event_timer_init(&stop, stop_loop, NULL);
+    assert(event_timer_start(&stop, ms * MS, 0) == STATUS_SUCCESS);
+    assert(event_loop_run() == STATUS_SUCCESS);
+}
+
+static link_event_port_info_t port_info(port_id_t port) {
+    link_event_port_info_t info;
+
+    assert(link_event_get_port_info(port, &info) == STATUS_SUCCESS);
+    return info;
+}
+
+static link_event_stats_t link_stats(void) {
+    link_event_stats_t stats;
+
+    assert(link_event_get_stats(&stats) == STATUS_SUCCESS);
+    return stats;
+}
+
+/* Short half-life so that a few seconds settle a flapping port */
+static void dampening_config(link_event_config_t *config) {
+    link_event_get_default_config(config);
+    config->coalesce_ms = 0;
+    config->dampening.enabled = true;
+    config->dampening.half_life_ms = 1000;
+    config->dampening.max_suppress_ms = 4000;
+}
+
+void test_link_event_config() {
+    link_event_config_t config;
+    link_event_stats_t stats;
+    link_event_port_info_t info;
+
+    link_event_get_default_config(&config);
+    assert(config.coalesce_ms == 10 && !config.dampening.enabled);
+
+    assert(link_event_report(1, false) == STATUS_NOT_INITIALIZED);
+    assert(link_event_get_stats(&stats) == STATUS_NOT_INITIALIZED);
+    assert(link_event_get_port_info(1, &info) == STATUS_NOT_INITIALIZED);
+    assert(link_event_set_config(&config) == STATUS_NOT_INITIALIZED);
+    assert(link_event_flush() == 0);
+    assert(link_event_shutdown() == STATUS_NOT_INITIALIZED);
+
+    // Dampening parameters are checked only when dampening is on
+    config.dampening.reuse_threshold = config.dampening.suppress_threshold;
+    assert(link_event_init(&config) == STATUS_SUCCESS);
+    config.dampening.enabled = true;
+    assert(link_event_set_config(&config) == STATUS_INVALID_PARAMETER);
+    config.dampening.reuse_threshold = 750;
+    config.dampening.half_life_ms = 0;
+    assert(link_event_set_config(&config) == STATUS_INVALID_PARAMETER);
+    assert(link_event_report(CONFIG_MAX_PORTS, false) == STATUS_INVALID_PARAMETER);
+
+    // Ports start up; reporting what is already known changes nothing
+    info = port_info(1);
+    assert(info.link_up && info.delivered_up && !info.suppressed && info.flaps == 0);
+    assert(link_event_report(1, true) == STATUS_SUCCESS);
+    assert(link_stats().reported == 0);
+
+    // Subscribers are limited and found by callback and argument
+    for (int i = 0; i < LINK_EVENT_MAX_SUBSCRIBERS; i++) {
+        assert(link_event_subscribe(ignore_batch, (void *)(intptr_t)i) == STATUS_SUCCESS);
+    }
+    assert(link_event_subscribe(ignore_batch, NULL) == STATUS_RESOURCE_EXHAUSTED);
+    assert(link_event_subscribe(NULL, NULL) == STATUS_INVALID_PARAMETER);
+    assert(link_event_unsubscribe(ignore_batch, (void *)(intptr_t)LINK_EVENT_MAX_SUBSCRIBERS) == STATUS_NOT_FOUND);
+    for (int i = 0; i < LINK_EVENT_MAX_SUBSCRIBERS; i++) {
+        assert(link_event_unsubscribe(ignore_batch, (void *)(intptr_t)i) == STATUS_SUCCESS);
+    }
+
+    assert(link_event_shutdown() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_link_event_config");
+}
+
+void test_link_event_coalesce() {
+    link_event_config_t config;
+    link_event_stats_t stats;
+
+    link_event_get_default_config(&config);
+    assert(link_event_init(&config) == STATUS_SUCCESS);
+    memset(&g_log, 0, sizeof(g_log));
+    assert(link_event_subscribe(record_batch, &g_log) == STATUS_SUCCESS);
+
+    // Transitions within an interval make one batch
+    assert(link_event_report(1, false) == STATUS_SUCCESS);
+    assert(link_event_report(2, false) == STATUS_SUCCESS);
+    assert(link_event_report(3, false) == STATUS_SUCCESS);
+    assert(link_event_report(3, true) == STATUS_SUCCESS);
+    assert(g_log.batches == 0);
+    run_for(config.coalesce_ms * 3);
+    assert(g_log.batches == 1 && g_log.last.count == 2);
+    assert(link_event_batch_has(&g_log.last, 1) && !link_event_batch_up(&g_log.last, 1));
+    assert(link_event_batch_has(&g_log.last, 2) && !link_event_batch_up(&g_log.last, 2));
+
+    // A port that went down and came back is left out
+    assert(!link_event_batch_has(&g_log.last, 3));
+    stats = link_stats();
+    assert(stats.reported == 4 && stats.batches == 1 && stats.changes == 2 && stats.coalesced == 1);
+    assert(!port_info(1).delivered_up && port_info(3).delivered_up && port_info(3).flaps == 1);
+
+    // A flush delivers at once
+    assert(link_event_report(1, true) == STATUS_SUCCESS);
+    assert(link_event_flush() == 1);
+    assert(g_log.batches == 2 && link_event_batch_up(&g_log.last, 1));
+    assert(link_event_flush() == 0);
+
+    // Without an interval every report is delivered by itself
+    config.coalesce_ms = 0;
+    assert(link_event_set_config(&config) == STATUS_SUCCESS);
+    assert(link_event_report(2, true) == STATUS_SUCCESS);
+    assert(g_log.batches == 3 && g_log.last.count == 1 && link_event_batch_up(&g_log.last, 2));
+
+    assert(link_event_unsubscribe(record_batch, &g_log) == STATUS_SUCCESS);
+    assert(link_event_shutdown() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_link_event_coalesce");
+}
+
+void test_link_event_dampening() {
+    link_event_config_t config;
+    link_event_port_info_t info;
+    const port_id_t port = 5;
+
+    dampening_config(&config);
+    assert(link_event_init(&config) == STATUS_SUCCESS);
+    memset(&g_log, 0, sizeof(g_log));
+    assert(link_event_subscribe(record_batch, &g_log) == STATUS_SUCCESS);
+
+    // Two flaps stay under the suppress threshold and are delivered
+    for (int i = 0; i < 2; i++) {
+        assert(link_event_report(port, false) == STATUS_SUCCESS);
+        assert(link_event_report(port, true) == STATUS_SUCCESS);
+    }
+    assert(g_log.batches == 4 && link_event_batch_up(&g_log.last, port));
+    assert(!port_info(port).suppressed);
+
+    // The third holds the port down though the link comes back
+    assert(link_event_report(port, false) == STATUS_SUCCESS);
+    assert(link_event_report(port, true) == STATUS_SUCCESS);
+    info = port_info(port);
+    assert(info.suppressed && info.link_up && !info.delivered_up);
+    assert(info.penalty > config.dampening.suppress_threshold);
+    assert(g_log.batches == 5 && !link_event_batch_up(&g_log.last, port));
+    assert(link_stats().suppressions == 1);
+
+    // The penalty halves every half-life until the port is let go
+    run_for(config.dampening.half_life_ms);
+    info = port_info(port);
+    assert(info.suppressed && info.penalty < config.dampening.suppress_threshold);
+    run_for(config.dampening.half_life_ms * 3 / 2);
+    info = port_info(port);
+    assert(!info.suppressed && info.delivered_up && info.penalty < config.dampening.reuse_threshold);
+    assert(g_log.batches == 6 && link_event_batch_up(&g_log.last, port));
+
+    // However often it flaps, the penalty is capped so that the port is
+    // reused within max_suppress_ms of the last flap
+    for (int i = 0; i < 50; i++) {
+        assert(link_event_report(port, false) == STATUS_SUCCESS);
+        assert(link_event_report(port, true) == STATUS_SUCCESS);
+    }
+    assert(port_info(port).suppressed);
+    run_for(config.dampening.max_suppress_ms + 500);
+    assert(!port_info(port).suppressed);
+
+    // Turning dampening off releases suppressed ports at once
+    for (int i = 0; i < 3; i++) {
+        assert(link_event_report(port, false) == STATUS_SUCCESS);
+        assert(link_event_report(port, true) == STATUS_SUCCESS);
+    }
+    assert(port_info(port).suppressed);
+    config.dampening.enabled = false;
+    assert(link_event_set_config(&config) == STATUS_SUCCESS);
+    info = port_info(port);
+    assert(!info.suppressed && info.delivered_up && info.penalty == 0);
+    assert(link_event_batch_up(&g_log.last, port));
+
+    assert(link_event_unsubscribe(record_batch, &g_log) == STATUS_SUCCESS);
+    assert(link_event_shutdown() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_link_event_dampening");
+}
+
+int main() {
+    printf("Running link event unit tests...\n");
+
+    assert(sim_clock_set_mode(SIM_CLOCK_VIRTUAL) == STATUS_SUCCESS);
+    assert(event_loop_init() == STATUS_SUCCESS);
+
+    test_link_event_config();
+    test_link_event_coalesce();
+    test_link_event_dampening();
+
+    assert(event_loop_shutdown() == STATUS_SUCCESS);
+
+    printf("All link event tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,216 @@
+/**
+ * @file test_lock_stat.c
+ * @brief Unit tests for spinlock contention profiling
+ *
+ * The test builds its own locks with CONFIG_SPINLOCK_STATS, whatever the
+ * library was built with; the class registry is the library's.
+ */
+
+#define CONFIG_SPINLOCK_STATS 1
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../../include/common/threading.h"
+#include "../../include/common/lock_stat.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define HOLD_US 20000
+#define THREADS 4
+#define ROUNDS 20000
+
+static spinlock_t g_lock;
+static volatile bool g_waiting;
+static uint64_t g_shared;
+
+/* Find a class in a snapshot */
+static const lock_stat_class_t *find_class(const lock_stat_class_t *classes, uint32_t count, const char *name) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (strcmp(classes[i].name, name) == 0) {
+            return &classes[i];
+        }
+    }
+    return NULL;
+}
+
+static void *wait_for_lock(void *arg) {
+    (void)arg;
+    g_waiting = true;
+    spinlock_acquire(&g_lock);
+    spinlock_release(&g_lock);
+    return NULL;
+}
+
+static void *hammer(void *arg) {
+    (void)arg;
+    for (uint32_t i = 0; i < ROUNDS; i++) {
+        spinlock_acquire(&g_lock);
+        g_shared++;
+        spinlock_release(&g_lock);
+    }
+    return NULL;
+}
+
+void test_lock_stat_classes() {
+    lock_stat_class_t classes[LOCK_STAT_MAX_CLASSES];
+    lock_stat_class_t *a = lock_stat_class("test.a");
+    char name[64];
+
+    // One class per name, truncated names included
+    assert(a != NULL && lock_stat_class("test.a") == a);
+    assert(lock_stat_class(NULL) == NULL);
+    memset(name, 'x', sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    assert(lock_stat_class(name) == lock_stat_class(name));
+    assert(strlen(lock_stat_class(name)->name) == LOCK_STAT_NAME_MAX - 1);
+
+    // The registry is bounded, and says so with NULL
+    for (uint32_t i = 0; i < LOCK_STAT_MAX_CLASSES; i++) {
+        snprintf(name, sizeof(name), "test.fill%u", i);
+        lock_stat_class(name);
+    }
+    assert(lock_stat_class("test.one_too_many") == NULL);
+    assert(lock_stat_snapshot(classes, LOCK_STAT_MAX_CLASSES) == LOCK_STAT_MAX_CLASSES);
+    assert(lock_stat_snapshot(classes, 1) == 1 && strcmp(classes[0].name, "test.a") == 0);
+    assert(lock_stat_snapshot(NULL, 1) == 0);
+
+    printf(TEST_PASSED, "test_lock_stat_classes");
+}
+
+void test_lock_stat_histogram() {
+    uint64_t hist[LOCK_STAT_BUCKETS] = { 0 };
+
+    // Bucket b holds 2^(b-1) to 2^b - 1
+    assert(lock_stat_bucket(0) == 0 && lock_stat_bucket(1) == 1);
+    assert(lock_stat_bucket(2) == 2 && lock_stat_bucket(3) == 2 && lock_stat_bucket(4) == 3);
+    assert(lock_stat_bucket(1023) == 10 && lock_stat_bucket(1024) == 11);
+    assert(lock_stat_bucket(UINT64_MAX) == LOCK_STAT_BUCKETS - 1);
+
+    assert(lock_stat_percentile(hist, 99.0) == 0);
+    hist[lock_stat_bucket(100)] = 98;
+    hist[lock_stat_bucket(5000)] = 2;
+    assert(lock_stat_percentile(hist, 50.0) == 127);
+    assert(lock_stat_percentile(hist, 99.0) == 8191);
+    assert(lock_stat_percentile(hist, 100.0) == 8191);
+    assert(lock_stat_percentile(hist, 0.0) == 127);
+
+    printf(TEST_PASSED, "test_lock_stat_histogram");
+}
+
+void test_lock_stat_spinlock() {
+    lock_stat_class_t classes[LOCK_STAT_MAX_CLASSES];
+    const lock_stat_class_t *cls;
+    spinlock_stats_t stats;
+    pthread_t thread;
+    uint32_t count;
+
+    // Uncontended: counted, no wait, the hold timed
+    spinlock_init(&g_lock);
+    spinlock_set_class(&g_lock, "test.a");
+    lock_stat_clear();
+    spinlock_acquire(&g_lock);
+    spinlock_release(&g_lock);
+    assert(spinlock_try_acquire(&g_lock) == 0);
+    assert(spinlock_try_acquire(&g_lock) != 0);
+    spinlock_release(&g_lock);
+    spinlock_get_stats(&g_lock, &stats);
+    assert(stats.acquisitions == 2 && stats.contended == 0 && stats.spins == 0);
+    count = lock_stat_snapshot(classes, LOCK_STAT_MAX_CLASSES);
+    cls = find_class(classes, count, "test.a");
+    assert(cls && cls->acquisitions == 2 && cls->contended == 0 && cls->wait_ns == 0);
+
+    // A waiter that has to wait out a long hold
+    spinlock_acquire(&g_lock);
+    g_waiting = false;
+    assert(pthread_create(&thread, NULL, wait_for_lock, NULL) == 0);
+    while (!g_waiting) {
+        cpu_relax();
+    }
+    usleep(HOLD_US);
+    spinlock_release(&g_lock);
+    assert(pthread_join(thread, NULL) == 0);
+
+    spinlock_get_stats(&g_lock, &stats);
+    assert(stats.acquisitions == 4 && stats.contended == 1 && stats.spins > 0);
+    count = lock_stat_snapshot(classes, LOCK_STAT_MAX_CLASSES);
+    cls = find_class(classes, count, "test.a");
+    assert(cls->acquisitions == 4 && cls->contended == 1 && cls->spins == stats.spins);
+    assert(cls->wait_max_ns == cls->wait_ns && cls->wait_ns >= HOLD_US * 1000ULL / 2);
+    assert(cls->hold_max_ns >= HOLD_US * 1000ULL && cls->hold_ns >= cls->hold_max_ns);
+    assert(cls->wait_hist[lock_stat_bucket(cls->wait_ns)] == 1);
+    assert(cls->hold_hist[lock_stat_bucket(cls->hold_max_ns)] >= 1);
+
+    lock_stat_clear();
+    count = lock_stat_snapshot(classes, LOCK_STAT_MAX_CLASSES);
+    cls = find_class(classes, count, "test.a");
+    assert(cls->acquisitions == 0 && cls->hold_max_ns == 0 && cls->wait_hist[lock_stat_bucket(1)] == 0);
+
+    printf(TEST_PASSED, "test_lock_stat_spinlock");
+}
+
+void test_lock_stat_threads() {
+    lock_stat_class_t classes[LOCK_STAT_MAX_CLASSES];
+    const lock_stat_class_t *cls;
+    pthread_t threads[THREADS];
+    uint64_t hist_total = 0;
+    uint32_t count;
+
+    // Every acquisition of every thread lands in the class
+    g_shared = 0;
+    for (uint32_t i = 0; i < THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, hammer, NULL) == 0);
+    }
+    for (uint32_t i = 0; i < THREADS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+    assert(g_shared == (uint64_t)THREADS * ROUNDS);
+
+    count = lock_stat_snapshot(classes, LOCK_STAT_MAX_CLASSES);
+    cls = find_class(classes, count, "test.a");
+    assert(cls->acquisitions == (uint64_t)THREADS * ROUNDS);
+    assert(cls->contended <= cls->acquisitions);
+    for (uint32_t b = 0; b < LOCK_STAT_BUCKETS; b++) {
+        hist_total += cls->hold_hist[b];
+    }
+    assert(hist_total == cls->acquisitions);
+
+    printf(TEST_PASSED, "test_lock_stat_threads");
+}
+
+void test_lock_stat_report() {
+    char buf[8192];
+    char small[64];
+    size_t len;
+
+    // Only classes that were taken get a line
+    len = lock_stat_report(buf, sizeof(buf));
+    assert(len == strlen(buf) && len < sizeof(buf));
+    assert(strncmp(buf, "Lock contention", 15) == 0);
+    assert(strstr(buf, "\ntest.a ") != NULL);
+    assert(strstr(buf, "test.fill0") == NULL);
+
+    // A short buffer is truncated and terminated, and the full length returned
+    assert(lock_stat_report(small, sizeof(small)) == len);
+    assert(strlen(small) == sizeof(small) - 1);
+    assert(lock_stat_report(NULL, 10) == 0);
+
+    printf(TEST_PASSED, "test_lock_stat_report");
+}
+
+int main() {
+    printf("Running lock contention unit tests...\n");
+
+    test_lock_stat_classes();
+    test_lock_stat_histogram();
+    test_lock_stat_spinlock();
+    test_lock_stat_threads();
+    test_lock_stat_report();
+
+    printf("All lock contention tests completed successfully.\n");
+    return 0;
+}
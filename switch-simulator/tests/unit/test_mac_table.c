@@ -7,129 +7,320 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 #include "../../include/l2/mac_table.h"
+#include "../../include/hal/port.h"
 #include "../../include/common/error_codes.h"
 
 #define TEST_PASSED "[ PASSED ] %s\n"
 #define TEST_FAILED "[ FAILED ] %s: %s\n"
 
+#define AGING_TIME 300
+#define STABLE_MACS 256
+#define INSERTED_MACS 20000
+#define PAGED_MACS 800
+
+static mac_addr_t test_mac(uint32_t n) {
+    mac_addr_t mac = { .addr = { 0x02, 0x00, (uint8_t)(n >> 24), (uint8_t)(n >> 16),
+                                 (uint8_t)(n >> 8), (uint8_t)n } };
+    return mac;
+}
+
+static uint32_t entry_count(void) {
+    mac_table_stats_t stats;
+
+    assert(mac_table_get_stats(&stats) == STATUS_SUCCESS);
+    return stats.total_entries;
+}
+
+static void age_to(uint32_t now) {
+    assert(mac_table_process_aging((mac_table_t *)mac_table_get_instance(), now) == STATUS_SUCCESS);
+}
+
 void test_mac_table_init() {
-    mac_table_t table;
-    uint32_t result = mac_table_init(&table, 1024);
-    assert(result == SUCCESS);
-    assert(table.size == 0);
-    assert(table.capacity == 1024);
-    
-    mac_table_destroy(&table);
+    mac_table_stats_t stats;
+
+    assert(mac_table_init(1024, AGING_TIME) == STATUS_SUCCESS);
+    assert(mac_table_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.total_entries == 0);
+    assert(stats.table_size >= 1024);
+    assert(stats.aging_time == AGING_TIME);
+
+    assert(mac_table_deinit() == STATUS_SUCCESS);
     printf(TEST_PASSED, "test_mac_table_init");
 }
 
 void test_mac_entry_add() {
-    mac_table_t table;
-    mac_addr_t mac = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
-    uint16_t vlan_id = 100;
-    uint32_t port_id = 5;
-    
-    mac_table_init(&table, 1024);
-    
+    mac_addr_t mac = test_mac(1);
+    mac_table_stats_t stats;
+    port_id_t port;
+
+    assert(mac_table_init(1024, AGING_TIME) == STATUS_SUCCESS);
+
     // Add new entry
-    uint32_t result = mac_table_add(&table, mac, vlan_id, port_id, MAC_ENTRY_STATIC);
-    assert(result == SUCCESS);
-    assert(table.size == 1);
-    
-    // Add duplicate entry
-    result = mac_table_add(&table, mac, vlan_id, port_id, MAC_ENTRY_STATIC);
-    assert(result == MAC_ENTRY_EXISTS);
-    assert(table.size == 1);
-    
-    mac_table_destroy(&table);
+    assert(mac_table_add(mac, 5, 100, false) == STATUS_SUCCESS);
+    assert(entry_count() == 1);
+
+    // Adding it again updates it in place
+    assert(mac_table_add(mac, 5, 100, false) == STATUS_SUCCESS);
+    assert(entry_count() == 1);
+
+    // The same address on another VLAN is another entry
+    assert(mac_table_add(mac, 6, 200, true) == STATUS_SUCCESS);
+    assert(mac_table_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.total_entries == 2 && stats.static_entries == 1);
+
+    // A station that moves is learned on its new port
+    assert(mac_table_add(mac, 7, 100, false) == STATUS_SUCCESS);
+    assert(mac_table_lookup(mac, 100, &port) == STATUS_SUCCESS);
+    assert(port == 7);
+
+    assert(mac_table_deinit() == STATUS_SUCCESS);
     printf(TEST_PASSED, "test_mac_entry_add");
 }
 
 void test_mac_entry_lookup() {
-    mac_table_t table;
-    mac_addr_t mac = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
-    uint16_t vlan_id = 100;
-    uint32_t port_id = 5;
-    mac_entry_t entry;
-    
-    mac_table_init(&table, 1024);
-    mac_table_add(&table, mac, vlan_id, port_id, MAC_ENTRY_STATIC);
-    
+    mac_addr_t macs[3] = { test_mac(1), test_mac(2), test_mac(3) };
+    vlan_id_t vlans[3] = { 100, 100, 100 };
+    port_id_t ports[3];
+    uint64_t hit_mask;
+    port_id_t port;
+
+    assert(mac_table_init(1024, AGING_TIME) == STATUS_SUCCESS);
+    assert(mac_table_add(macs[0], 5, 100, true) == STATUS_SUCCESS);
+    assert(mac_table_add(macs[2], 6, 100, false) == STATUS_SUCCESS);
+
     // Lookup existing entry
-    uint32_t result = mac_table_lookup(&table, mac, vlan_id, &entry);
-    assert(result == SUCCESS);
-    assert(entry.port_id == port_id);
-    assert(entry.entry_type == MAC_ENTRY_STATIC);
-    
-    // Lookup non-existing entry
-    mac_addr_t invalid_mac = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-    result = mac_table_lookup(&table, invalid_mac, vlan_id, &entry);
-    assert(result == MAC_ENTRY_NOT_FOUND);
-    
-    mac_table_destroy(&table);
+    assert(mac_table_lookup(macs[0], 100, &port) == STATUS_SUCCESS);
+    assert(port == 5);
+
+    // Lookup non-existing entry, and an existing one on the wrong VLAN
+    assert(mac_table_lookup(macs[1], 100, &port) == STATUS_NOT_FOUND);
+    assert(mac_table_lookup(macs[0], 101, &port) == STATUS_NOT_FOUND);
+
+    // A burst reports each address on its own
+    assert(mac_table_lookup_bulk(macs, vlans, 3, ports, &hit_mask) == STATUS_SUCCESS);
+    assert(hit_mask == 0x5);
+    assert(ports[0] == 5 && ports[1] == PORT_ID_INVALID && ports[2] == 6);
+
+    assert(mac_table_deinit() == STATUS_SUCCESS);
     printf(TEST_PASSED, "test_mac_entry_lookup");
 }
 
 void test_mac_entry_delete() {
-    mac_table_t table;
-    mac_addr_t mac = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
-    uint16_t vlan_id = 100;
-    uint32_t port_id = 5;
-    
-    mac_table_init(&table, 1024);
-    mac_table_add(&table, mac, vlan_id, port_id, MAC_ENTRY_STATIC);
-    
+    mac_addr_t mac = test_mac(1);
+    port_id_t port;
+
+    assert(mac_table_init(1024, AGING_TIME) == STATUS_SUCCESS);
+    assert(mac_table_add(mac, 5, 100, true) == STATUS_SUCCESS);
+
     // Delete existing entry
-    uint32_t result = mac_table_delete(&table, mac, vlan_id);
-    assert(result == SUCCESS);
-    assert(table.size == 0);
-    
+    assert(mac_table_remove(mac, 100) == STATUS_SUCCESS);
+    assert(entry_count() == 0);
+    assert(mac_table_lookup(mac, 100, &port) == STATUS_NOT_FOUND);
+
     // Delete non-existing entry
-    result = mac_table_delete(&table, mac, vlan_id);
-    assert(result == MAC_ENTRY_NOT_FOUND);
-    
-    mac_table_destroy(&table);
+    assert(mac_table_remove(mac, 100) == STATUS_NOT_FOUND);
+
+    assert(mac_table_deinit() == STATUS_SUCCESS);
     printf(TEST_PASSED, "test_mac_entry_delete");
 }
 
+void test_mac_table_full() {
+    mac_table_hw_profile_t profile = { .mode = MAC_TABLE_MODE_BANKED, .banks = 2, .rows = 4,
+                                       .ways = 2, .overflow = 1 };
+    mac_table_stats_t stats;
+    uint32_t added = 0, refused = 0, first_refused = 0, n;
+    port_id_t port;
+    status_t status;
+
+    assert(mac_table_init(1024, AGING_TIME) == STATUS_SUCCESS);
+    assert(mac_table_set_hw_profile(&profile) == STATUS_SUCCESS);
+
+    // Two banks of four 2-way rows and an overflow entry each hold 18 at most
+    for (n = 0; n < 64; n++) {
+        status = mac_table_add(test_mac(n), 1, 100, false);
+        if (status == STATUS_SUCCESS) {
+            added++;
+        } else {
+            assert(status == STATUS_TABLE_FULL);
+            if (refused++ == 0) {
+                first_refused = n;
+            }
+        }
+    }
+    assert(added > 0 && added <= 18);
+    assert(refused == 64 - added);
+    assert(entry_count() == added);
+    assert(mac_table_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.learn_failures == refused);
+
+    // Refused addresses are not in the table, and learned ones are untouched
+    assert(mac_table_lookup(test_mac(first_refused), 100, &port) == STATUS_NOT_FOUND);
+    assert(mac_table_lookup(test_mac(0), 100, &port) == STATUS_SUCCESS);
+
+    // Once the dynamic entries are gone a refused address is learned
+    assert(mac_table_flush(0, PORT_ID_INVALID, false) == STATUS_SUCCESS);
+    assert(entry_count() == 0);
+    assert(mac_table_add(test_mac(first_refused), 1, 100, false) == STATUS_SUCCESS);
+
+    assert(mac_table_deinit() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_mac_table_full");
+}
+
 void test_mac_table_aging() {
-    mac_table_t table;
-    mac_addr_t mac = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
-    uint16_t vlan_id = 100;
-    uint32_t port_id = 5;
-    
-    mac_table_init(&table, 1024);
-    mac_table_add(&table, mac, vlan_id, port_id, MAC_ENTRY_DYNAMIC);
-    
-    // Simulate aging
-    mac_table_process_aging(&table, 300); // Pass 300 seconds
-    
-    // Entry should still exist
-    mac_entry_t entry;
-    uint32_t result = mac_table_lookup(&table, mac, vlan_id, &entry);
-    assert(result == SUCCESS);
-    
-    // Now age out completely
-    mac_table_process_aging(&table, 300); // Another 300 seconds (total > aging time)
-    
-    // Entry should be removed
-    result = mac_table_lookup(&table, mac, vlan_id, &entry);
-    assert(result == MAC_ENTRY_NOT_FOUND);
-    
-    mac_table_destroy(&table);
+    mac_addr_t idle = test_mac(1);
+    mac_addr_t active = test_mac(2);
+    mac_addr_t fixed = test_mac(3);
+    port_id_t port;
+
+    assert(mac_table_init(1024, AGING_TIME) == STATUS_SUCCESS);
+    assert(mac_table_add(idle, 5, 100, false) == STATUS_SUCCESS);
+    assert(mac_table_add(active, 5, 100, false) == STATUS_SUCCESS);
+    assert(mac_table_add(fixed, 5, 100, true) == STATUS_SUCCESS);
+
+    // Nothing ages before the aging time has passed
+    age_to(200);
+    assert(entry_count() == 3);
+
+    // A hit keeps an entry; the one not seen since it was learned goes
+    assert(mac_table_lookup(active, 100, &port) == STATUS_SUCCESS);
+    age_to(AGING_TIME + 2);
+    assert(mac_table_lookup(idle, 100, &port) == STATUS_NOT_FOUND);
+    assert(mac_table_lookup(active, 100, &port) == STATUS_SUCCESS);
+    assert(entry_count() == 2);
+
+    // Static entries never age
+    age_to(10 * AGING_TIME);
+    assert(mac_table_lookup(active, 100, &port) == STATUS_NOT_FOUND);
+    assert(mac_table_lookup(fixed, 100, &port) == STATUS_SUCCESS);
+    assert(entry_count() == 1);
+
+    assert(mac_table_deinit() == STATUS_SUCCESS);
     printf(TEST_PASSED, "test_mac_table_aging");
 }
 
+static volatile int g_stop;
+
+static void *stable_reader(void *arg) {
+    uint64_t *lookups = arg;
+    port_id_t port;
+
+    // Entries that stay put are found through every displacement and split
+    while (!__atomic_load_n(&g_stop, __ATOMIC_ACQUIRE)) {
+        for (uint32_t n = 0; n < STABLE_MACS; n++) {
+            assert(mac_table_lookup(test_mac(n), 100, &port) == STATUS_SUCCESS);
+            assert(port == n % 8);
+            (*lookups)++;
+        }
+    }
+    return NULL;
+}
+
+void test_mac_table_concurrent_read() {
+    pthread_t reader;
+    uint64_t lookups = 0;
+    uint32_t n;
+    port_id_t port;
+
+    assert(mac_table_init(1024, AGING_TIME) == STATUS_SUCCESS);
+    for (n = 0; n < STABLE_MACS; n++) {
+        assert(mac_table_add(test_mac(n), n % 8, 100, true) == STATUS_SUCCESS);
+    }
+
+    g_stop = 0;
+    assert(pthread_create(&reader, NULL, stable_reader, &lookups) == 0);
+    // Enough inserts to fill the cuckoo buckets and grow the table
+    for (n = STABLE_MACS; n < STABLE_MACS + INSERTED_MACS; n++) {
+        assert(mac_table_add(test_mac(n), 1, 100, false) == STATUS_SUCCESS);
+    }
+    __atomic_store_n(&g_stop, 1, __ATOMIC_RELEASE);
+    assert(pthread_join(reader, NULL) == 0);
+    assert(lookups > 0);
+
+    assert(entry_count() == STABLE_MACS + INSERTED_MACS);
+    for (n = 0; n < STABLE_MACS + INSERTED_MACS; n++) {
+        assert(mac_table_lookup(test_mac(n), 100, &port) == STATUS_SUCCESS);
+    }
+
+    assert(mac_table_deinit() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_mac_table_concurrent_read");
+}
+
+/* Read the whole table in pages of max_entries, counting each address seen */
+static uint32_t read_pages(uint32_t max_entries, uint8_t *seen) {
+    mac_table_entry_t entries[64];
+    table_cursor_t cursor = TABLE_CURSOR_START;
+    uint32_t total = 0, count, n;
+
+    memset(seen, 0, PAGED_MACS);
+    while (cursor != TABLE_CURSOR_END) {
+        assert(mac_table_get_entries_page(&cursor, entries, max_entries, &count) == STATUS_SUCCESS);
+        assert(count <= max_entries);
+        for (uint32_t i = 0; i < count; i++) {
+            n = ((uint32_t)entries[i].mac_addr.addr[4] << 8) | entries[i].mac_addr.addr[5];
+            assert(n < PAGED_MACS && entries[i].vlan_id == 100 && entries[i].port_id == 1 + n % 4);
+            seen[n]++;
+        }
+        total += count;
+    }
+    return total;
+}
+
+void test_mac_table_pages() {
+    mac_table_entry_t entries[4];
+    uint8_t seen[PAGED_MACS];
+    table_cursor_t cursor = TABLE_CURSOR_START;
+    uint32_t count, n;
+
+    assert(mac_table_init(1024, AGING_TIME) == STATUS_SUCCESS);
+    for (n = 0; n < PAGED_MACS; n++) {
+        assert(mac_table_add(test_mac(n), 1 + n % 4, 100, false) == STATUS_SUCCESS);
+    }
+
+    // Any page size returns every entry exactly once
+    assert(read_pages(1, seen) == PAGED_MACS);
+    for (n = 0; n < PAGED_MACS; n++) {
+        assert(seen[n] == 1);
+    }
+    assert(read_pages(64, seen) == PAGED_MACS);
+    for (n = 0; n < PAGED_MACS; n++) {
+        assert(seen[n] == 1);
+    }
+
+    // An ended walk stays ended
+    cursor = TABLE_CURSOR_END;
+    assert(mac_table_get_entries_page(&cursor, entries, 4, &count) == STATUS_SUCCESS);
+    assert(count == 0 && cursor == TABLE_CURSOR_END);
+    cursor = TABLE_CURSOR_START;
+    assert(mac_table_get_entries_page(&cursor, entries, 0, &count) == STATUS_INVALID_PARAMETER);
+    assert(mac_table_get_entries_page(NULL, entries, 4, &count) == STATUS_INVALID_PARAMETER);
+
+    // An empty table ends on the first page
+    assert(mac_table_flush(0, PORT_ID_INVALID, false) == STATUS_SUCCESS);
+    assert(mac_table_get_entries_page(&cursor, entries, 4, &count) == STATUS_SUCCESS);
+    assert(count == 0 && cursor == TABLE_CURSOR_END);
+
+    assert(mac_table_deinit() == STATUS_SUCCESS);
+    assert(mac_table_get_entries_page(&cursor, entries, 4, &count) == STATUS_NOT_INITIALIZED);
+    printf(TEST_PASSED, "test_mac_table_pages");
+}
+
 int main() {
     printf("Running MAC Table unit tests...\n");
-    
+
+    // Entries are only learned on ports the hardware simulation has
+    assert(port_init() == STATUS_SUCCESS);
+
     test_mac_table_init();
     test_mac_entry_add();
     test_mac_entry_lookup();
     test_mac_entry_delete();
+    test_mac_table_full();
     test_mac_table_aging();
-    
+    test_mac_table_concurrent_read();
+    test_mac_table_pages();
+
     printf("All MAC Table tests completed successfully.\n");
     return 0;
 }
@@ -0,0 +1,245 @@
+/**
+ * @file test_mcast_fib.c
+ * @brief Unit tests for the IPv4 multicast FIB and its replication
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/l3/mcast_fib.h"
+#include "../../include/hal/packet.h"
+#include "../../include/hal/packet_offload.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define ADDR(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (d))
+
+#define SOURCE ADDR(10, 0, 0, 5)
+#define GROUP ADDR(239, 1, 2, 3)
+#define IN_PORT 1
+#define IN_VLAN 10
+#define PAYLOAD_LEN 64
+#define FRAME_LEN (14 + 20 + PAYLOAD_LEN)
+#define MAX_COPIES 8
+
+/* Copies handed to the transmit callback, flattened */
+typedef struct {
+    uint32_t count;
+    port_id_t ports[MAX_COPIES];
+    uint32_t lengths[MAX_COPIES];
+    uint32_t segments[MAX_COPIES];
+    uint8_t frames[MAX_COPIES][FRAME_LEN + 4];
+} capture_t;
+
+static capture_t g_capture;
+
+static status_t capture(port_id_t port_id, packet_buffer_t *packet, void *arg) {
+    capture_t *c = arg;
+    uint32_t n = c->count++;
+
+    assert(n < MAX_COPIES);
+    c->ports[n] = port_id;
+    c->lengths[n] = packet_chain_length(packet);
+    c->segments[n] = packet_segment_count(packet);
+    assert(c->lengths[n] <= sizeof(c->frames[n]));
+    assert(packet_copy_data(packet, 0, c->frames[n], c->lengths[n]) == STATUS_SUCCESS);
+    return STATUS_SUCCESS;
+}
+
+static uint16_t ip_checksum(const uint8_t *ip) {
+    return packet_csum_fold(packet_csum_add(0, ip, 20));
+}
+
+/* UDP datagram from source to group, received untagged */
+static packet_buffer_t *make_datagram(ipv4_addr_t source, ipv4_addr_t group, uint8_t ttl) {
+    uint8_t frame[FRAME_LEN] = {
+        0x01, 0x00, 0x5e, 0, 0, 0, 0x02, 0, 0, 0, 0, 0x05, 0x08, 0x00,
+        0x45, 0x00, 0x00, 20 + PAYLOAD_LEN, 0, 0, 0, 0, 0, 17, 0, 0,
+    };
+    packet_buffer_t *packet = packet_buffer_alloc(FRAME_LEN);
+    uint16_t csum;
+
+    assert(packet != NULL);
+    frame[22] = ttl;
+    for (int i = 0; i < 4; i++) {
+        frame[26 + i] = (uint8_t)(source >> (24 - 8 * i));
+        frame[30 + i] = (uint8_t)(group >> (24 - 8 * i));
+    }
+    csum = ip_checksum(frame + 14);
+    frame[24] = (uint8_t)(csum >> 8);
+    frame[25] = (uint8_t)csum;
+    for (int i = 0; i < PAYLOAD_LEN; i++) {
+        frame[34 + i] = (uint8_t)i;
+    }
+    assert(packet_append_data(packet, frame, FRAME_LEN) == STATUS_SUCCESS);
+    return packet;
+}
+
+static status_t forward(packet_buffer_t *packet, port_id_t in_port, vlan_id_t in_vlan, uint32_t *copies) {
+    memset(&g_capture, 0, sizeof(g_capture));
+    return mfib_forward(packet, 14, in_port, in_vlan, capture, &g_capture, copies);
+}
+
+void test_mfib_routes() {
+    mfib_oif_t oif = { .port_id = 2, .vlan_id = 20, .src_mac = { .addr = { 0x02, 0, 0, 0, 0, 0x20 } } };
+    mfib_route_t route;
+    mfib_stats_t stats;
+
+    assert(mfib_route_add(SOURCE, GROUP, IN_PORT, IN_VLAN) == STATUS_NOT_INITIALIZED);
+    assert(mfib_init(0) == STATUS_SUCCESS);
+
+    // Only multicast groups have routes
+    assert(mfib_route_add(SOURCE, ADDR(10, 1, 1, 1), IN_PORT, IN_VLAN) == STATUS_INVALID_PARAMETER);
+    assert(mfib_route_add(SOURCE, GROUP, IN_PORT, IN_VLAN) == STATUS_SUCCESS);
+    assert(mfib_route_add(MFIB_ANY_SOURCE, GROUP, PORT_ID_INVALID, 0) == STATUS_SUCCESS);
+    assert(mfib_oif_add(SOURCE, ADDR(239, 9, 9, 9), &oif) == STATUS_NOT_FOUND);
+
+    // Interfaces are keyed by port and VLAN; adding one again updates it
+    assert(mfib_oif_add(SOURCE, GROUP, &oif) == STATUS_SUCCESS);
+    oif.tagged = true;
+    assert(mfib_oif_add(SOURCE, GROUP, &oif) == STATUS_SUCCESS);
+    oif.vlan_id = 30;
+    assert(mfib_oif_add(SOURCE, GROUP, &oif) == STATUS_SUCCESS);
+    assert(mfib_route_get(SOURCE, GROUP, &route) == STATUS_SUCCESS);
+    assert(route.iif == IN_PORT && route.iif_vlan == IN_VLAN && route.oif_count == 2);
+    assert(route.oifs[0].tagged);
+
+    // Changing the incoming interface keeps the outgoing ones
+    assert(mfib_route_add(SOURCE, GROUP, IN_PORT, 0) == STATUS_SUCCESS);
+    assert(mfib_route_get(SOURCE, GROUP, &route) == STATUS_SUCCESS);
+    assert(route.iif_vlan == 0 && route.oif_count == 2);
+
+    assert(mfib_oif_remove(SOURCE, GROUP, 2, 30) == STATUS_SUCCESS);
+    assert(mfib_oif_remove(SOURCE, GROUP, 2, 30) == STATUS_NOT_FOUND);
+    assert(mfib_route_get(MFIB_ANY_SOURCE, GROUP, &route) == STATUS_SUCCESS);
+    assert(route.oif_count == 0);
+
+    for (uint32_t i = 0; i < CONFIG_MFIB_MAX_OIFS; i++) {
+        oif.port_id = (port_id_t)(10 + i);
+        assert(mfib_oif_add(MFIB_ANY_SOURCE, GROUP, &oif) == STATUS_SUCCESS);
+    }
+    oif.port_id = 9;
+    assert(mfib_oif_add(MFIB_ANY_SOURCE, GROUP, &oif) == STATUS_RESOURCE_EXHAUSTED);
+
+    assert(mfib_route_delete(MFIB_ANY_SOURCE, GROUP) == STATUS_SUCCESS);
+    assert(mfib_route_delete(MFIB_ANY_SOURCE, GROUP) == STATUS_NOT_FOUND);
+    assert(mfib_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.routes == 1);
+
+    printf(TEST_PASSED, "test_mfib_routes");
+}
+
+void test_mfib_replication() {
+    mfib_oif_t oifs[3] = {
+        { .port_id = 2, .vlan_id = 20, .src_mac = { .addr = { 0x02, 0, 0, 0, 0, 0x20 } } },
+        { .port_id = 3, .vlan_id = 30, .tagged = true, .src_mac = { .addr = { 0x02, 0, 0, 0, 0, 0x30 } } },
+        { .port_id = IN_PORT, .vlan_id = IN_VLAN },
+    };
+    packet_buffer_t *packet = make_datagram(SOURCE, GROUP, 64);
+    uint8_t original[FRAME_LEN];
+    uint32_t copies;
+    mfib_route_t route;
+
+    assert(mfib_route_add(SOURCE, GROUP, IN_PORT, IN_VLAN) == STATUS_SUCCESS);
+    assert(mfib_oif_remove(SOURCE, GROUP, 2, 20) == STATUS_SUCCESS);
+    for (int i = 0; i < 3; i++) {
+        assert(mfib_oif_add(SOURCE, GROUP, &oifs[i]) == STATUS_SUCCESS);
+    }
+    memcpy(original, packet->data, FRAME_LEN);
+
+    // One copy per interface but the one the datagram came in on
+    assert(forward(packet, IN_PORT, IN_VLAN, &copies) == STATUS_SUCCESS);
+    assert(copies == 2 && g_capture.count == 2);
+    assert(memcmp(packet->data, original, FRAME_LEN) == 0);
+
+    for (uint32_t i = 0; i < 2; i++) {
+        const uint8_t *frame = g_capture.frames[i];
+        uint32_t tag = oifs[i].tagged ? 4 : 0;
+        const uint8_t *ip = frame + 14 + tag;
+
+        // Rewritten L2 header, routed IP header, payload untouched and not copied
+        assert(g_capture.ports[i] == oifs[i].port_id);
+        assert(g_capture.lengths[i] == FRAME_LEN + tag && g_capture.segments[i] >= 2);
+        assert(frame[0] == 0x01 && frame[3] == 0x01 && frame[4] == 0x02 && frame[5] == 0x03);
+        assert(memcmp(frame + 6, oifs[i].src_mac.addr, MAC_ADDR_LEN) == 0);
+        if (tag) {
+            assert(frame[12] == 0x81 && frame[13] == 0x00);
+            assert((((frame[14] << 8) | frame[15]) & 0x0FFF) == oifs[i].vlan_id);
+        }
+        assert(ip[8] == 63 && ip_checksum(ip) == 0);
+        assert(memcmp(ip + 20, original + 34, PAYLOAD_LEN) == 0);
+    }
+
+    assert(mfib_route_get(SOURCE, GROUP, &route) == STATUS_SUCCESS);
+    assert(route.packets == 1 && route.bytes == FRAME_LEN);
+    packet_buffer_free(packet);
+
+    printf(TEST_PASSED, "test_mfib_replication");
+}
+
+void test_mfib_lookup() {
+    mfib_oif_t oif = { .port_id = 5, .vlan_id = 50 };
+    packet_buffer_t *packet;
+    mfib_stats_t before, after;
+    mfib_route_t route;
+    uint32_t copies;
+
+    assert(mfib_get_stats(&before) == STATUS_SUCCESS);
+
+    // Another source falls back to the (*,G) route, which accepts any interface
+    packet = make_datagram(ADDR(10, 0, 0, 6), GROUP, 64);
+    assert(forward(packet, IN_PORT, IN_VLAN, &copies) == STATUS_NOT_FOUND);
+    assert(mfib_route_add(MFIB_ANY_SOURCE, GROUP, PORT_ID_INVALID, 0) == STATUS_SUCCESS);
+    assert(mfib_oif_add(MFIB_ANY_SOURCE, GROUP, &oif) == STATUS_SUCCESS);
+    assert(forward(packet, 7, 70, &copies) == STATUS_SUCCESS);
+    assert(copies == 1 && g_capture.ports[0] == 5);
+    packet_buffer_free(packet);
+
+    // The (S,G) route checks where its datagrams come from
+    packet = make_datagram(SOURCE, GROUP, 64);
+    assert(forward(packet, 7, IN_VLAN, &copies) == STATUS_PERMISSION_DENIED);
+    assert(copies == 0 && g_capture.count == 0);
+    assert(forward(packet, IN_PORT, 11, &copies) == STATUS_PERMISSION_DENIED);
+    assert(mfib_route_get(SOURCE, GROUP, &route) == STATUS_SUCCESS);
+    assert(route.rpf_failures == 2);
+    packet_buffer_free(packet);
+
+    // Datagrams about to expire are not routed
+    packet = make_datagram(SOURCE, GROUP, 1);
+    assert(forward(packet, IN_PORT, IN_VLAN, &copies) == STATUS_INVALID_PACKET);
+    packet_buffer_free(packet);
+
+    packet = make_datagram(SOURCE, ADDR(239, 7, 7, 7), 64);
+    assert(forward(packet, IN_PORT, IN_VLAN, &copies) == STATUS_NOT_FOUND);
+    packet->data[14] = 0x65;
+    assert(forward(packet, IN_PORT, IN_VLAN, &copies) == STATUS_INVALID_PACKET);
+    packet_buffer_free(packet);
+
+    assert(mfib_get_stats(&after) == STATUS_SUCCESS);
+    assert(after.routes == 2);
+    assert(after.forwarded - before.forwarded == 1 && after.copies - before.copies == 1);
+    assert(after.no_route - before.no_route == 2);
+    assert(after.rpf_failures - before.rpf_failures == 2);
+    assert(after.ttl_expired - before.ttl_expired == 1);
+
+    printf(TEST_PASSED, "test_mfib_lookup");
+}
+
+int main() {
+    printf("Running multicast FIB unit tests...\n");
+
+    assert(packet_init() == STATUS_SUCCESS);
+
+    test_mfib_routes();
+    test_mfib_replication();
+    test_mfib_lookup();
+
+    assert(mfib_deinit() == STATUS_SUCCESS);
+    assert(mfib_deinit() == STATUS_NOT_INITIALIZED);
+
+    printf("All multicast FIB tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,302 @@
+/**
+ * @file test_mcast_snoop.c
+ * @brief Unit tests for IGMP and MLD snooping
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/l2/mcast_snoop.h"
+#include "../../include/hal/packet.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define VLAN 10
+#define OTHER_VLAN 20
+#define ROUTER_PORT 1
+#define HOST_A 3
+#define HOST_B 4
+
+#define GROUP(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (d))
+
+static uint32_t g_now;
+
+static void put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static mac_addr_t group_mac(uint32_t group) {
+    mac_addr_t mac = { .addr = { 0x01, 0x00, 0x5e, (uint8_t)((group >> 16) & 0x7f),
+                                 (uint8_t)(group >> 8), (uint8_t)group } };
+    return mac;
+}
+
+/* Parsed IPv4 frame to a group, carrying an L4 message */
+static packet_buffer_t *ipv4_frame(uint32_t group, uint8_t proto, const uint8_t *msg, uint32_t len) {
+    uint8_t frame[128] = {
+        0, 0, 0, 0, 0, 0, 0x02, 0, 0, 0, 0, 0x10, 0x08, 0x00,
+        0x45, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+        10, 0, 0, 9,
+    };
+    mac_addr_t mac = group_mac(group);
+    packet_buffer_t *packet = packet_buffer_alloc(sizeof(frame));
+
+    assert(packet != NULL && 34 + len <= sizeof(frame));
+    memcpy(frame, mac.addr, MAC_ADDR_LEN);
+    frame[16] = (uint8_t)((20 + len) >> 8);
+    frame[17] = (uint8_t)(20 + len);
+    frame[23] = proto;
+    put32(frame + 30, group);
+    memcpy(frame + 34, msg, len);
+    assert(packet_append_data(packet, frame, 34 + len) == STATUS_SUCCESS);
+    assert(packet_parse(packet) == STATUS_SUCCESS);
+    return packet;
+}
+
+static bool process(packet_buffer_t *packet, vlan_id_t vlan_id, port_id_t in_port, vlan_port_bitmap_t *ports) {
+    bool constrained = mcast_snoop_process(packet, vlan_id, in_port, ports);
+
+    packet_buffer_free(packet);
+    return constrained;
+}
+
+/* IGMPv1/v2 message: report, leave or query */
+static bool igmp(uint8_t type, uint32_t group, port_id_t port_id, vlan_port_bitmap_t *ports) {
+    uint8_t msg[8] = { type, 0 };
+
+    put32(msg + 4, group);
+    return process(ipv4_frame(type == 0x11 ? GROUP(224, 0, 0, 1) : group, 2, msg, sizeof(msg)),
+                   VLAN, port_id, ports);
+}
+
+/* Data frame to a group */
+static bool data(uint32_t group, vlan_id_t vlan_id, vlan_port_bitmap_t *ports) {
+    const uint8_t udp[8] = { 0x13, 0x88, 0x13, 0x88, 0x00, 0x08, 0x00, 0x00 };
+
+    return process(ipv4_frame(group, 17, udp, sizeof(udp)), vlan_id, 2, ports);
+}
+
+static bool has(const vlan_port_bitmap_t *ports, port_id_t port_id) {
+    return (ports->w[port_id / 64] >> (port_id % 64)) & 1;
+}
+
+static uint32_t count(const vlan_port_bitmap_t *ports) {
+    uint32_t n = 0;
+
+    for (uint32_t w = 0; w < VLAN_PORT_WORDS; w++) {
+        n += (uint32_t)__builtin_popcountll(ports->w[w]);
+    }
+    return n;
+}
+
+static bool member(uint32_t group, port_id_t port_id) {
+    mac_addr_t mac = group_mac(group);
+    vlan_port_bitmap_t ports;
+
+    return mcast_snoop_get_group(VLAN, &mac, &ports) == STATUS_SUCCESS && has(&ports, port_id);
+}
+
+static void tick(uint32_t seconds) {
+    for (uint32_t i = 0; i < seconds; i++) {
+        assert(mcast_snoop_process_timers(++g_now) == STATUS_SUCCESS);
+    }
+}
+
+void test_mcast_snoop_config() {
+    mcast_snoop_config_t config;
+    vlan_port_bitmap_t ports;
+
+    assert(mcast_snoop_set_vlan(VLAN, true) == STATUS_NOT_INITIALIZED);
+    assert(mcast_snoop_init(0) == STATUS_SUCCESS);
+
+    mcast_snoop_get_default_config(&config);
+    assert(config.membership_interval == 260 && config.router_interval == 260);
+    assert(config.last_member_time == 2 && !config.fast_leave && !config.flood_unregistered);
+    config.membership_interval = 1;
+    assert(mcast_snoop_set_config(&config) == STATUS_INVALID_PARAMETER);
+    assert(mcast_snoop_set_config(NULL) == STATUS_INVALID_PARAMETER);
+    assert(mcast_snoop_set_vlan(0, true) == STATUS_INVALID_PARAMETER);
+
+    // Without snooping a report and its group flood the VLAN
+    assert(!igmp(0x16, GROUP(239, 1, 1, 1), HOST_A, &ports));
+    assert(!data(GROUP(239, 1, 1, 1), VLAN, &ports));
+
+    config.membership_interval = 10;
+    config.router_interval = 10;
+    assert(mcast_snoop_set_config(&config) == STATUS_SUCCESS);
+    assert(mcast_snoop_set_vlan(VLAN, true) == STATUS_SUCCESS);
+
+    printf(TEST_PASSED, "test_mcast_snoop_config");
+}
+
+void test_mcast_snoop_igmp() {
+    mac_addr_t mac = group_mac(GROUP(239, 1, 1, 1));
+    vlan_port_bitmap_t ports;
+    mcast_snoop_stats_t stats;
+
+    // A query makes its port a router port and floods
+    assert(!igmp(0x11, 0, ROUTER_PORT, &ports));
+    assert(mcast_snoop_get_router_ports(VLAN, &ports) == STATUS_SUCCESS);
+    assert(has(&ports, ROUTER_PORT) && count(&ports) == 1);
+
+    // Reports go to router ports only
+    assert(igmp(0x16, GROUP(239, 1, 1, 1), HOST_A, &ports));
+    assert(has(&ports, ROUTER_PORT) && count(&ports) == 1);
+    assert(igmp(0x12, GROUP(239, 1, 1, 1), HOST_B, &ports));
+    assert(mcast_snoop_get_group(VLAN, &mac, &ports) == STATUS_SUCCESS);
+    assert(has(&ports, HOST_A) && has(&ports, HOST_B) && count(&ports) == 2);
+
+    // Data goes to listeners and router ports
+    assert(data(GROUP(239, 1, 1, 1), VLAN, &ports));
+    assert(has(&ports, HOST_A) && has(&ports, HOST_B) && has(&ports, ROUTER_PORT) && count(&ports) == 3);
+
+    // Groups sharing a MAC address share the entry
+    assert(data(GROUP(239, 129, 1, 1), VLAN, &ports));
+    assert(has(&ports, HOST_A));
+
+    // Unregistered groups go to router ports; link-local groups and other VLANs flood
+    assert(data(GROUP(239, 2, 2, 2), VLAN, &ports));
+    assert(has(&ports, ROUTER_PORT) && count(&ports) == 1);
+    assert(!data(GROUP(224, 0, 0, 5), VLAN, &ports));
+    assert(!data(GROUP(239, 1, 1, 1), OTHER_VLAN, &ports));
+
+    assert(mcast_snoop_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.queries == 1 && stats.reports == 2 && stats.groups == 1);
+    assert(stats.forwarded == 2 && stats.unregistered == 1);
+
+    printf(TEST_PASSED, "test_mcast_snoop_igmp");
+}
+
+void test_mcast_snoop_leave() {
+    mcast_snoop_config_t config;
+    vlan_port_bitmap_t ports;
+
+    // A leave takes effect after the last member time, unless a report answers
+    assert(igmp(0x17, GROUP(239, 1, 1, 1), HOST_A, &ports));
+    assert(member(GROUP(239, 1, 1, 1), HOST_A));
+    tick(1);
+    assert(member(GROUP(239, 1, 1, 1), HOST_A));
+    tick(1);
+    assert(!member(GROUP(239, 1, 1, 1), HOST_A) && member(GROUP(239, 1, 1, 1), HOST_B));
+
+    assert(igmp(0x17, GROUP(239, 1, 1, 1), HOST_B, &ports));
+    assert(igmp(0x16, GROUP(239, 1, 1, 1), HOST_B, &ports));
+    tick(2);
+    assert(member(GROUP(239, 1, 1, 1), HOST_B));
+
+    // With fast leave the port goes at once, and the group with its last listener
+    mcast_snoop_get_default_config(&config);
+    config.membership_interval = 10;
+    config.router_interval = 10;
+    config.fast_leave = true;
+    assert(mcast_snoop_set_config(&config) == STATUS_SUCCESS);
+    assert(igmp(0x17, GROUP(239, 1, 1, 1), HOST_B, &ports));
+    mac_addr_t mac = group_mac(GROUP(239, 1, 1, 1));
+    assert(mcast_snoop_get_group(VLAN, &mac, &ports) == STATUS_NOT_FOUND);
+
+    config.fast_leave = false;
+    assert(mcast_snoop_set_config(&config) == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_mcast_snoop_leave");
+}
+
+void test_mcast_snoop_v3_and_mld() {
+    // IGMPv3 report: EXCLUDE {} joins 239.3.3.3, TO_INCLUDE {} leaves 239.4.4.4
+    uint8_t v3[8 + 2 * 8] = { 0x22, 0, 0, 0, 0, 0, 0, 2 };
+    vlan_port_bitmap_t ports;
+
+    v3[8] = 2;
+    put32(v3 + 12, GROUP(239, 3, 3, 3));
+    v3[16] = 3;
+    put32(v3 + 20, GROUP(239, 4, 4, 4));
+    assert(igmp(0x16, GROUP(239, 4, 4, 4), HOST_A, &ports));
+    assert(process(ipv4_frame(GROUP(224, 0, 0, 22), 2, v3, sizeof(v3)), VLAN, HOST_A, &ports));
+    assert(member(GROUP(239, 3, 3, 3), HOST_A));
+    tick(2);
+    assert(!member(GROUP(239, 4, 4, 4), HOST_A));
+
+    // MLDv1 report for ff0e::1:2 behind a hop-by-hop header
+    static const uint8_t group[16] = { 0xff, 0x0e, [13] = 0x01, [15] = 0x02 };
+    uint8_t frame[14 + 40 + 8 + 24] = {
+        0x33, 0x33, 0x00, 0x01, 0x00, 0x02, 0x02, 0, 0, 0, 0, 0x10, 0x86, 0xdd,
+        0x60, 0, 0, 0, 0, 32, 0, 1, 0xfe, 0x80,
+    };
+    uint8_t *hbh = frame + 54;
+    uint8_t *mld = hbh + 8;
+    packet_buffer_t *packet = packet_buffer_alloc(sizeof(frame));
+
+    memcpy(frame + 38, group, sizeof(group));
+    hbh[0] = 58;
+    hbh[2] = 5;                             // Router alert
+    hbh[3] = 2;
+    mld[0] = 131;
+    memcpy(mld + 8, group, sizeof(group));
+    assert(packet != NULL);
+    assert(packet_append_data(packet, frame, sizeof(frame)) == STATUS_SUCCESS);
+    assert(packet_parse(packet) == STATUS_SUCCESS);
+    assert(process(packet, VLAN, HOST_B, &ports));
+
+    mac_addr_t mac = { .addr = { 0x33, 0x33, 0x00, 0x01, 0x00, 0x02 } };
+    assert(mcast_snoop_get_group(VLAN, &mac, &ports) == STATUS_SUCCESS);
+    assert(has(&ports, HOST_B) && count(&ports) == 1);
+
+    printf(TEST_PASSED, "test_mcast_snoop_v3_and_mld");
+}
+
+void test_mcast_snoop_aging() {
+    mcast_snoop_group_t groups[8];
+    vlan_port_bitmap_t ports;
+    uint32_t n;
+
+    assert(mcast_snoop_get_groups(groups, 8, &n) == STATUS_SUCCESS);
+    assert(n == 2);
+
+    // A static router port outlives the detected one
+    assert(mcast_snoop_set_router_port(VLAN, HOST_B + 1, true) == STATUS_SUCCESS);
+    assert(igmp(0x16, GROUP(239, 5, 5, 5), HOST_A, &ports));
+
+    // Without reports everything detected is gone within the interval
+    tick(11);
+    assert(mcast_snoop_get_groups(groups, 8, &n) == STATUS_SUCCESS);
+    assert(n == 0);
+    assert(mcast_snoop_get_router_ports(VLAN, &ports) == STATUS_SUCCESS);
+    assert(has(&ports, HOST_B + 1) && count(&ports) == 1);
+
+    // Flushing a port removes it everywhere
+    assert(igmp(0x16, GROUP(239, 5, 5, 5), HOST_A, &ports));
+    assert(igmp(0x16, GROUP(239, 5, 5, 5), HOST_B, &ports));
+    assert(mcast_snoop_flush_port(HOST_A) == STATUS_SUCCESS);
+    assert(!member(GROUP(239, 5, 5, 5), HOST_A) && member(GROUP(239, 5, 5, 5), HOST_B));
+
+    // Disabling the VLAN drops what it learned
+    assert(mcast_snoop_set_vlan(VLAN, false) == STATUS_SUCCESS);
+    assert(mcast_snoop_get_groups(groups, 8, &n) == STATUS_SUCCESS);
+    assert(n == 0);
+    assert(mcast_snoop_get_router_ports(VLAN, &ports) == STATUS_SUCCESS);
+    assert(count(&ports) == 0);
+
+    printf(TEST_PASSED, "test_mcast_snoop_aging");
+}
+
+int main() {
+    printf("Running multicast snooping unit tests...\n");
+
+    assert(packet_init() == STATUS_SUCCESS);
+
+    test_mcast_snoop_config();
+    test_mcast_snoop_igmp();
+    test_mcast_snoop_leave();
+    test_mcast_snoop_v3_and_mld();
+    test_mcast_snoop_aging();
+
+    assert(mcast_snoop_deinit() == STATUS_SUCCESS);
+    assert(mcast_snoop_deinit() == STATUS_NOT_INITIALIZED);
+
+    printf("All multicast snooping tests completed successfully.\n");
+    return 0;
+}
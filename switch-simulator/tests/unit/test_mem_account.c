@@ -0,0 +1,174 @@
+/**
+ * @file test_mem_account.c
+ * @brief Unit tests for the per-subsystem memory accounting
+ *
+ * Nothing else in the test charges the management or ARP subsystems, so
+ * their counters move only by what the test does.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <malloc.h>
+#include "../../include/common/mem_account.h"
+#include "../../include/common/mem_arena.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define OBJECTS 8
+
+static mem_account_stats_t stats_of(mem_tag_t tag) {
+    mem_account_stats_t stats;
+
+    assert(mem_account_get(tag, &stats) == STATUS_SUCCESS);
+    return stats;
+}
+
+void test_mem_account_heap() {
+    void *ptrs[OBJECTS];
+    mem_account_stats_t stats;
+    uint64_t bytes = 0;
+    uint8_t *zeroed;
+    void *aligned;
+
+    // Every wrapper charges the usable size of what it returns
+    stats = stats_of(MEM_TAG_MGMT);
+    assert(stats.heap_bytes == 0 && stats.heap_objects == 0 && stats.allocations == 0);
+    for (uint32_t i = 0; i < OBJECTS; i++) {
+        ptrs[i] = mem_malloc(MEM_TAG_MGMT, 100 * (i + 1));
+        assert(ptrs[i] != NULL);
+        bytes += malloc_usable_size(ptrs[i]);
+    }
+    stats = stats_of(MEM_TAG_MGMT);
+    assert(stats.heap_bytes == bytes && stats.heap_objects == OBJECTS && stats.allocations == OBJECTS);
+    assert(stats.heap_peak_bytes == bytes);
+
+    zeroed = mem_calloc(MEM_TAG_MGMT, 10, 30);
+    assert(zeroed != NULL && zeroed[0] == 0 && zeroed[299] == 0);
+    bytes += malloc_usable_size(zeroed);
+    aligned = mem_aligned_alloc(MEM_TAG_MGMT, 256, 1000);
+    assert(aligned != NULL && ((uintptr_t)aligned & 255) == 0);
+    stats = stats_of(MEM_TAG_MGMT);
+    assert(stats.heap_objects == OBJECTS + 2 && stats.allocations == OBJECTS + 2);
+    assert(stats.heap_bytes >= bytes + 1000);
+
+    // Freed memory leaves the count, not the peak
+    for (uint32_t i = 1; i < OBJECTS; i++) {
+        mem_free(MEM_TAG_MGMT, ptrs[i]);
+    }
+    mem_free(MEM_TAG_MGMT, zeroed);
+    mem_free(MEM_TAG_MGMT, NULL);
+    stats = stats_of(MEM_TAG_MGMT);
+    assert(stats.heap_objects == 2 && stats.heap_peak_bytes > stats.heap_bytes);
+    mem_free(MEM_TAG_MGMT, ptrs[0]);
+    mem_free(MEM_TAG_MGMT, aligned);
+    stats = stats_of(MEM_TAG_MGMT);
+    assert(stats.heap_bytes == 0 && stats.heap_objects == 0 && stats.heap_peak_bytes > 0);
+
+    printf(TEST_PASSED, "test_mem_account_heap");
+}
+
+void test_mem_account_realloc() {
+    mem_account_stats_t before = stats_of(MEM_TAG_MGMT), stats;
+    uint8_t *ptr;
+
+    // Growing replaces the old size with the new one, as one more allocation
+    ptr = mem_realloc(MEM_TAG_MGMT, NULL, 64);
+    assert(ptr != NULL);
+    memset(ptr, 0x5a, 64);
+    ptr = mem_realloc(MEM_TAG_MGMT, ptr, 4096);
+    assert(ptr != NULL && ptr[63] == 0x5a);
+    stats = stats_of(MEM_TAG_MGMT);
+    assert(stats.heap_objects == before.heap_objects + 1 && stats.allocations == before.allocations + 2);
+    assert(stats.heap_bytes == before.heap_bytes + malloc_usable_size(ptr));
+
+    // A failed resize leaves the memory and its charge alone
+    assert(mem_realloc(MEM_TAG_MGMT, ptr, SIZE_MAX / 2) == NULL);
+    assert(ptr[0] == 0x5a);
+    stats = stats_of(MEM_TAG_MGMT);
+    assert(stats.failures == before.failures + 1 && stats.heap_objects == before.heap_objects + 1);
+
+    mem_free(MEM_TAG_MGMT, ptr);
+    stats = stats_of(MEM_TAG_MGMT);
+    assert(stats.heap_bytes == before.heap_bytes && stats.heap_objects == before.heap_objects);
+
+    // Failures are counted, and so are bad tags, as other
+    before = stats_of(MEM_TAG_OTHER);
+    assert(mem_malloc(MEM_TAG_MGMT, SIZE_MAX / 2) == NULL);
+    assert(mem_calloc(MEM_TAG_MGMT, SIZE_MAX / 2, 4) == NULL);
+    assert(stats_of(MEM_TAG_MGMT).failures == stats.failures + 2);
+    ptr = mem_malloc((mem_tag_t)MEM_TAG_COUNT, 32);
+    assert(ptr != NULL && stats_of(MEM_TAG_OTHER).heap_objects == before.heap_objects + 1);
+    mem_free((mem_tag_t)MEM_TAG_COUNT, ptr);
+    assert(stats_of(MEM_TAG_OTHER).heap_objects == before.heap_objects);
+
+    printf(TEST_PASSED, "test_mem_account_realloc");
+}
+
+void test_mem_account_arena() {
+    mem_arena_t *arena = mem_arena_create("arp");
+    mem_account_stats_t stats;
+    void *block;
+
+    // A subsystem's arenas count towards it
+    assert(arena != NULL);
+    assert(stats_of(MEM_TAG_ARP).arena_used_bytes == 0);
+    block = mem_arena_alloc(arena, 4096, 0);
+    assert(block != NULL);
+    stats = stats_of(MEM_TAG_ARP);
+    assert(stats.arena_used_bytes >= 4096 && stats.arena_peak_bytes >= stats.arena_used_bytes);
+    assert(stats.arena_mapped_bytes >= stats.arena_used_bytes && stats.heap_bytes == 0);
+
+    mem_arena_free(arena, block, 4096);
+    stats = stats_of(MEM_TAG_ARP);
+    assert(stats.arena_used_bytes == 0 && stats.arena_peak_bytes >= 4096);
+
+    // A reset restarts every mark from what is held now
+    mem_account_reset_peaks();
+    assert(stats_of(MEM_TAG_ARP).arena_peak_bytes == 0);
+    stats = stats_of(MEM_TAG_MGMT);
+    assert(stats.heap_peak_bytes == stats.heap_bytes);
+    mem_arena_destroy(arena);
+
+    printf(TEST_PASSED, "test_mem_account_arena");
+}
+
+void test_mem_account_report() {
+    char buf[4096];
+    char small[40];
+    size_t len;
+
+    assert(strcmp(mem_tag_name(MEM_TAG_CONNTRACK), "conntrack") == 0);
+    assert(strcmp(mem_tag_name((mem_tag_t)MEM_TAG_COUNT), "unknown") == 0);
+    assert(mem_account_get((mem_tag_t)MEM_TAG_COUNT, NULL) == STATUS_INVALID_PARAMETER);
+    assert(mem_account_get(MEM_TAG_MGMT, NULL) == STATUS_INVALID_PARAMETER);
+
+    // Subsystems that never allocated get no line
+    len = mem_account_report(buf, sizeof(buf));
+    assert(len == strlen(buf));
+    assert(strncmp(buf, "Memory by subsystem", 19) == 0);
+    assert(strstr(buf, "\nmgmt ") != NULL && strstr(buf, "\ntotal ") != NULL);
+    assert(strstr(buf, "\nmpls ") == NULL);
+
+    // A short buffer is truncated and terminated, and the full length returned
+    assert(mem_account_report(small, sizeof(small)) == len);
+    assert(strlen(small) == sizeof(small) - 1);
+    assert(mem_account_report(NULL, 10) == 0);
+
+    printf(TEST_PASSED, "test_mem_account_report");
+}
+
+int main() {
+    printf("Running memory accounting unit tests...\n");
+
+    test_mem_account_heap();
+    test_mem_account_realloc();
+    test_mem_account_arena();
+    test_mem_account_report();
+
+    printf("All memory accounting tests completed successfully.\n");
+    return 0;
+}
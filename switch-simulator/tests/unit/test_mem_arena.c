@@ -0,0 +1,224 @@
+/**
+ * @file test_mem_arena.c
+ * @brief Unit tests for huge-page backed memory arenas
+ *
+ * Whether blocks land on explicit or transparent huge pages depends on the
+ * host; the checks hold for normal pages as well.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "../../include/common/mem_arena.h"
+#include "../../include/common/config.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define MB (1024 * 1024)
+#define THREADS 4
+#define THREAD_ALLOCS 1000
+#define THREAD_ALLOC_SIZE 64
+
+static mem_arena_t *g_arena;
+
+static void *alloc_thread(void *arg) {
+    uint8_t **ptrs = (uint8_t **)arg;
+
+    for (int i = 0; i < THREAD_ALLOCS; i++) {
+        ptrs[i] = (uint8_t *)mem_arena_alloc(g_arena, THREAD_ALLOC_SIZE, 0);
+        assert(ptrs[i] != NULL);
+        memset(ptrs[i], 0xFF, THREAD_ALLOC_SIZE);
+    }
+    return NULL;
+}
+
+static int compare_ptrs(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(uint8_t *const *)a;
+    uintptr_t y = (uintptr_t)*(uint8_t *const *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static mem_arena_stats_t stats_of(mem_arena_t *arena) {
+    mem_arena_stats_t stats;
+
+    assert(mem_arena_get_stats(arena, &stats) == STATUS_SUCCESS);
+    return stats;
+}
+
+void test_mem_arena_alloc() {
+    mem_arena_t *arena = mem_arena_create("test-alloc");
+    mem_arena_stats_t stats;
+    uint8_t *a;
+    uint8_t *b;
+    uint8_t *c;
+
+    assert(arena != NULL);
+    assert(mem_arena_create(NULL) == NULL);
+
+    // Nothing is mapped before the first allocation
+    stats = stats_of(arena);
+    assert(strcmp(stats.name, "test-alloc") == 0);
+    assert(stats.arenas == 1 && stats.blocks == 0 && stats.mapped_bytes == 0);
+
+    // Small allocations share a block, zeroed and aligned as asked
+    a = (uint8_t *)mem_arena_alloc(arena, 100, 0);
+    b = (uint8_t *)mem_arena_alloc(arena, 100, 4096);
+    c = (uint8_t *)mem_arena_alloc(arena, 1, 1);
+    assert(a && b && c);
+    assert(((uintptr_t)a & 15) == 0 && ((uintptr_t)b & 4095) == 0);
+    assert(b > a && c == b + 100);
+    for (int i = 0; i < 100; i++) {
+        assert(a[i] == 0 && b[i] == 0);
+    }
+    stats = stats_of(arena);
+    assert(stats.blocks == 1 && stats.mapped_bytes == CONFIG_MEM_ARENA_BLOCK_SIZE);
+    assert(stats.used_bytes == 201 && stats.allocations == 3);
+    assert(stats.page_size >= (uint64_t)sysconf(_SC_PAGESIZE));
+    assert(stats.hugetlb_bytes + stats.thp_bytes <= stats.mapped_bytes);
+
+    assert(mem_arena_alloc(arena, 0, 0) == NULL);
+    assert(mem_arena_alloc(arena, 16, 3) == NULL);
+    assert(mem_arena_alloc(arena, 16, 4 * MB) == NULL);
+    assert(mem_arena_alloc(NULL, 16, 0) == NULL);
+    assert(mem_arena_get_stats(arena, NULL) == STATUS_INVALID_PARAMETER);
+    assert(mem_arena_get_stats(NULL, &stats) == STATUS_INVALID_PARAMETER);
+
+    mem_arena_destroy(arena);
+    mem_arena_destroy(NULL);
+    printf(TEST_PASSED, "test_mem_arena_alloc");
+}
+
+void test_mem_arena_blocks() {
+    mem_arena_t *arena = mem_arena_create("test-blocks");
+    const size_t half = CONFIG_MEM_ARENA_BLOCK_SIZE / 2;
+    mem_arena_stats_t stats;
+    uint8_t *big;
+    uint8_t *first;
+    uint8_t *second;
+    uint8_t *third;
+
+    // A large allocation gets a mapping of its own, on a 2MB boundary
+    big = (uint8_t *)mem_arena_alloc(arena, 3 * MB, 0);
+    assert(big != NULL && ((uintptr_t)big & (2 * MB - 1)) == 0);
+    big[3 * MB - 1] = 1;
+    stats = stats_of(arena);
+    assert(stats.blocks == 1 && stats.mapped_bytes == 4 * MB);
+
+    // What does not fit the current block starts a new one
+    first = (uint8_t *)mem_arena_alloc(arena, half, 0);
+    second = (uint8_t *)mem_arena_alloc(arena, half, 0);
+    third = (uint8_t *)mem_arena_alloc(arena, 16, 0);
+    assert(first && second && third);
+    assert(second == first + half);
+    stats = stats_of(arena);
+    assert(stats.blocks == 3 && stats.used_bytes == 3 * MB + 2 * half + 16);
+
+    // A block goes back once all its allocations are freed
+    mem_arena_free(arena, big, 3 * MB);
+    stats = stats_of(arena);
+    assert(stats.blocks == 2 && stats.used_bytes == 2 * half + 16);
+    mem_arena_free(arena, first, half);
+    assert(stats_of(arena).blocks == 2);
+    mem_arena_free(arena, second, half);
+    assert(stats_of(arena).blocks == 1);
+    mem_arena_free(arena, NULL, 16);
+
+    // Freed memory is not reused while its block lives; the next block is fresh
+    first = (uint8_t *)mem_arena_alloc(arena, 16, 0);
+    assert(first == third + 16);
+    mem_arena_free(arena, first, 16);
+    mem_arena_free(arena, third, 16);
+    stats = stats_of(arena);
+    assert(stats.blocks == 0 && stats.used_bytes == 0);
+    first = (uint8_t *)mem_arena_alloc(arena, 16, 0);
+    assert(first != NULL && first[0] == 0);
+    assert(stats_of(arena).blocks == 1);
+
+    mem_arena_destroy(arena);
+    printf(TEST_PASSED, "test_mem_arena_blocks");
+}
+
+void test_mem_arena_names() {
+    mem_arena_t *x = mem_arena_create("test-shared");
+    mem_arena_t *y = mem_arena_create("test-shared");
+    mem_arena_t *named = mem_arena_get("test-named");
+    mem_arena_stats_t stats;
+    void *p;
+
+    // Arenas of one name are reported together
+    assert(x && y && x != y);
+    p = mem_arena_alloc(x, 1000, 0);
+    assert(mem_arena_alloc(y, 500, 0) != NULL);
+    assert(mem_arena_get_stats_by_name("test-shared", &stats) == STATUS_SUCCESS);
+    assert(stats.arenas == 2 && stats.blocks == 2 && stats.used_bytes == 1500);
+    assert(stats.peak_used_bytes == 1500);
+
+    // The high-water mark stays until reset
+    mem_arena_free(x, p, 1000);
+    assert(mem_arena_get_stats_by_name("test-shared", &stats) == STATUS_SUCCESS);
+    assert(stats.used_bytes == 500 && stats.peak_used_bytes == 1500);
+    mem_arena_reset_peaks();
+    assert(mem_arena_get_stats_by_name("test-shared", &stats) == STATUS_SUCCESS);
+    assert(stats.peak_used_bytes == 500);
+
+    // A destroyed arena is no longer listed
+    mem_arena_destroy(x);
+    mem_arena_destroy(y);
+    assert(mem_arena_get_stats_by_name("test-shared", &stats) == STATUS_NOT_FOUND);
+    assert(mem_arena_get_stats_by_name(NULL, &stats) == STATUS_INVALID_PARAMETER);
+
+    // A process-wide arena is created once and found by its name after
+    assert(named != NULL && mem_arena_get("test-named") == named);
+    assert(mem_arena_get_stats_by_name("test-named", &stats) == STATUS_SUCCESS);
+    assert(stats.arenas == 1);
+    assert(mem_arena_get(NULL) == NULL);
+
+    printf(TEST_PASSED, "test_mem_arena_names");
+}
+
+void test_mem_arena_threads() {
+    uint8_t **ptrs = (uint8_t **)calloc(THREADS * THREAD_ALLOCS, sizeof(uint8_t *));
+    pthread_t threads[THREADS];
+    mem_arena_stats_t stats;
+
+    assert(ptrs != NULL);
+    g_arena = mem_arena_create("test-threads");
+
+    // Allocations from several threads never overlap
+    for (int i = 0; i < THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, alloc_thread, &ptrs[i * THREAD_ALLOCS]) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+    qsort(ptrs, THREADS * THREAD_ALLOCS, sizeof(uint8_t *), compare_ptrs);
+    for (int i = 1; i < THREADS * THREAD_ALLOCS; i++) {
+        assert(ptrs[i] >= ptrs[i - 1] + THREAD_ALLOC_SIZE);
+    }
+    stats = stats_of(g_arena);
+    assert(stats.allocations == THREADS * THREAD_ALLOCS);
+    assert(stats.used_bytes == (uint64_t)THREADS * THREAD_ALLOCS * THREAD_ALLOC_SIZE);
+
+    mem_arena_destroy(g_arena);
+    free(ptrs);
+    printf(TEST_PASSED, "test_mem_arena_threads");
+}
+
+int main() {
+    printf("Running memory arena unit tests...\n");
+
+    test_mem_arena_alloc();
+    test_mem_arena_blocks();
+    test_mem_arena_names();
+    test_mem_arena_threads();
+
+    printf("All memory arena tests completed successfully.\n");
+    return 0;
+}
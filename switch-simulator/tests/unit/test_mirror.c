@@ -0,0 +1,304 @@
+/**
+ * @file test_mirror.c
+ * @brief Unit tests for port and VLAN mirroring
+ *
+ * The analyzer port gets a driver that records what leaves it, so the
+ * copies are checked byte for byte once its TX ring is drained.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/l2/mirror.h"
+#include "../../include/hal/hw_simulation.h"
+#include "../../include/hal/hw_resources.h"
+#include "../../include/hal/packet.h"
+#include "../../include/hal/driver.h"
+#include "../../include/common/config.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define SOURCE_PORT 1
+#define OTHER_PORT 2
+#define ANALYZER_PORT 5
+#define FRAME_LEN 128
+#define CAPTURE_MAX 16
+
+/* Frames the analyzer port sent */
+typedef struct {
+    driver_t drv;
+    uint32_t count;
+    uint32_t lengths[CAPTURE_MAX];
+    uint8_t frames[CAPTURE_MAX][FRAME_LEN + 4];
+} capture_t;
+
+static capture_t g_capture;
+
+static uint16_t capture_transmit_burst(driver_t *drv, packet_t **pkts, uint16_t n) {
+    capture_t *capture = (capture_t *)drv;
+
+    for (uint16_t i = 0; i < n; i++) {
+        uint32_t len = packet_chain_length(pkts[i]);
+
+        assert(capture->count < CAPTURE_MAX && len <= sizeof(capture->frames[0]));
+        assert(packet_peek_data(pkts[i], 0, capture->frames[capture->count], len) == STATUS_SUCCESS);
+        capture->lengths[capture->count++] = len;
+    }
+    return n;
+}
+
+static const driver_ops_t g_capture_ops = { .transmit_burst = capture_transmit_burst };
+
+static packet_buffer_t *make_frame(port_id_t port, uint8_t tag) {
+    uint8_t frame[FRAME_LEN];
+    packet_buffer_t *packet;
+
+    for (uint32_t i = 0; i < FRAME_LEN; i++) {
+        frame[i] = (uint8_t)(i + tag);
+    }
+    frame[12] = 0x08;
+    frame[13] = 0x00;
+    packet = packet_buffer_alloc(FRAME_LEN);
+    assert(packet != NULL);
+    assert(packet_append_data(packet, frame, FRAME_LEN) == STATUS_SUCCESS);
+    packet->metadata.port = port;
+    return packet;
+}
+
+/* Run frames received on a port through the ingress pipeline */
+static void receive(port_id_t port, vlan_id_t vlan, uint32_t count) {
+    packet_buffer_t *pkts[CAPTURE_MAX];
+    packet_result_t results[CAPTURE_MAX];
+
+    for (uint32_t i = 0; i < count; i++) {
+        pkts[i] = make_frame(port, (uint8_t)i);
+        pkts[i]->metadata.vlan = vlan;
+    }
+    assert(packet_process_burst(pkts, count, results) == STATUS_SUCCESS);
+    for (uint32_t i = 0; i < count; i++) {
+        assert(results[i] == PACKET_RESULT_FORWARD);
+        packet_buffer_free(pkts[i]);
+    }
+}
+
+/* Send what the analyzer port has queued and return how many frames left */
+static uint32_t drain_analyzer(void) {
+    g_capture.count = 0;
+    hw_sim_tx_drain(ANALYZER_PORT, 64);
+    return g_capture.count;
+}
+
+void test_mirror_session() {
+    mirror_session_config_t config = { .dest_port = ANALYZER_PORT };
+    mirror_session_config_t got;
+    mirror_session_stats_t stats;
+    uint32_t ids[CONFIG_MIRROR_MAX_SESSIONS];
+    uint32_t id;
+
+    assert(mirror_session_create(NULL, &id) == STATUS_INVALID_PARAMETER);
+
+    // Destinations are physical ports; truncation keeps at least the tagged header
+    config.dest_port = CONFIG_LAG_PORT_BASE;
+    assert(mirror_session_create(&config, &id) == STATUS_INVALID_PARAMETER);
+    config.dest_port = ANALYZER_PORT;
+    config.truncate_length = MIRROR_TRUNCATE_MIN - 1;
+    assert(mirror_session_create(&config, &id) == STATUS_INVALID_PARAMETER);
+    config.truncate_length = 0;
+    config.rspan = true;
+    assert(mirror_session_create(&config, &id) == STATUS_INVALID_PARAMETER);
+    config.rspan_vlan = 100;
+    config.rspan_priority = 8;
+    assert(mirror_session_create(&config, &id) == STATUS_INVALID_PARAMETER);
+    config.rspan_priority = 5;
+
+    assert(mirror_session_create(&config, &id) == STATUS_SUCCESS);
+    assert(mirror_session_get_config(id, &got) == STATUS_SUCCESS);
+    assert(got.dest_port == ANALYZER_PORT && got.rspan && got.rspan_vlan == 100 && got.rspan_priority == 5);
+    assert(mirror_session_get_stats(id, &stats) == STATUS_SUCCESS);
+    assert(stats.mirrored == 0 && stats.dropped == 0);
+
+    // A destination cannot be a source, nor a source a destination
+    assert(mirror_session_set_port(id, ANALYZER_PORT, MIRROR_DIR_INGRESS) == STATUS_INVALID_PARAMETER);
+    assert(mirror_session_set_port(id, ANALYZER_PORT, MIRROR_DIR_NONE) == STATUS_SUCCESS);
+    assert(mirror_session_set_port(id, CONFIG_LAG_PORT_BASE, MIRROR_DIR_INGRESS) == STATUS_INVALID_PARAMETER);
+    assert(mirror_session_set_port(id, SOURCE_PORT, (mirror_direction_t)4) == STATUS_INVALID_PARAMETER);
+    assert(mirror_session_set_port(id, SOURCE_PORT, MIRROR_DIR_BOTH) == STATUS_SUCCESS);
+    config.dest_port = SOURCE_PORT;
+    config.rspan = false;
+    assert(mirror_session_create(&config, &ids[0]) == STATUS_INVALID_PARAMETER);
+    assert(mirror_session_set_vlan(id, 0, MIRROR_DIR_INGRESS) == STATUS_INVALID_PARAMETER);
+    assert(mirror_session_set_vlan(id + 1, 10, MIRROR_DIR_INGRESS) == STATUS_NOT_FOUND);
+
+    // Every slot in use
+    config.dest_port = ANALYZER_PORT;
+    for (uint32_t i = 1; i < CONFIG_MIRROR_MAX_SESSIONS; i++) {
+        assert(mirror_session_create(&config, &ids[i]) == STATUS_SUCCESS);
+    }
+    assert(mirror_session_create(&config, &ids[0]) == STATUS_RESOURCE_EXHAUSTED);
+    for (uint32_t i = 1; i < CONFIG_MIRROR_MAX_SESSIONS; i++) {
+        assert(mirror_session_destroy(ids[i]) == STATUS_SUCCESS);
+    }
+
+    // Deleting the session frees its source port to be a destination
+    assert(mirror_session_destroy(id) == STATUS_SUCCESS);
+    assert(mirror_session_destroy(id) == STATUS_NOT_FOUND);
+    assert(mirror_session_get_config(id, &got) == STATUS_NOT_FOUND);
+    config.dest_port = SOURCE_PORT;
+    assert(mirror_session_create(&config, &id) == STATUS_SUCCESS);
+    assert(mirror_session_destroy(id) == STATUS_SUCCESS);
+
+    printf(TEST_PASSED, "test_mirror_session");
+}
+
+void test_mirror_span() {
+    mirror_session_config_t config = { .dest_port = ANALYZER_PORT };
+    mirror_session_stats_t stats;
+    packet_buffer_t *pkts[2];
+    uint8_t expected[FRAME_LEN];
+    uint32_t id;
+
+    assert(mirror_session_create(&config, &id) == STATUS_SUCCESS);
+    assert(mirror_session_set_port(id, SOURCE_PORT, MIRROR_DIR_INGRESS) == STATUS_SUCCESS);
+
+    // Frames received on the source are copied whole; other ports are not
+    receive(SOURCE_PORT, 0, 3);
+    receive(OTHER_PORT, 0, 2);
+    assert(drain_analyzer() == 3);
+    for (uint32_t i = 0; i < 3; i++) {
+        packet_buffer_t *frame = make_frame(SOURCE_PORT, (uint8_t)i);
+
+        assert(packet_peek_data(frame, 0, expected, FRAME_LEN) == STATUS_SUCCESS);
+        packet_buffer_free(frame);
+        assert(g_capture.lengths[i] == FRAME_LEN && memcmp(g_capture.frames[i], expected, FRAME_LEN) == 0);
+    }
+
+    // Ingress only: frames sent from the source are left alone
+    pkts[0] = make_frame(SOURCE_PORT, 0);
+    assert(hw_sim_tx_enqueue_burst(SOURCE_PORT, pkts, 1) == 1);
+    assert(drain_analyzer() == 0);
+
+    assert(mirror_session_set_port(id, SOURCE_PORT, MIRROR_DIR_EGRESS) == STATUS_SUCCESS);
+    receive(SOURCE_PORT, 0, 1);
+    pkts[0] = make_frame(SOURCE_PORT, 7);
+    pkts[1] = make_frame(SOURCE_PORT, 8);
+    assert(hw_sim_tx_enqueue_burst(SOURCE_PORT, pkts, 2) == 2);
+    assert(drain_analyzer() == 2);
+    assert(g_capture.frames[0][0] == 7 && g_capture.frames[1][0] == 8);
+    hw_sim_tx_drain(SOURCE_PORT, 64);
+
+    assert(mirror_session_get_stats(id, &stats) == STATUS_SUCCESS);
+    assert(stats.mirrored == 5 && stats.mirrored_bytes == 5 * FRAME_LEN);
+    assert(stats.dropped == 0 && stats.no_buffer == 0 && stats.sampled_out == 0);
+    assert(mirror_session_clear_stats(id) == STATUS_SUCCESS);
+    assert(mirror_session_get_stats(id, &stats) == STATUS_SUCCESS);
+    assert(stats.mirrored == 0 && stats.mirrored_bytes == 0);
+
+    assert(mirror_session_destroy(id) == STATUS_SUCCESS);
+    receive(SOURCE_PORT, 0, 1);
+    assert(drain_analyzer() == 0);
+
+    printf(TEST_PASSED, "test_mirror_span");
+}
+
+void test_mirror_vlan() {
+    mirror_session_config_t config = { .dest_port = ANALYZER_PORT };
+    uint32_t id;
+
+    assert(mirror_session_create(&config, &id) == STATUS_SUCCESS);
+    assert(mirror_session_set_vlan(id, 10, MIRROR_DIR_INGRESS) == STATUS_SUCCESS);
+
+    // Frames classified in the VLAN are copied, whatever port they came in on
+    receive(OTHER_PORT, 10, 2);
+    receive(SOURCE_PORT, 10, 1);
+    receive(SOURCE_PORT, 20, 3);
+    assert(drain_analyzer() == 3);
+
+    assert(mirror_session_set_vlan(id, 10, MIRROR_DIR_NONE) == STATUS_SUCCESS);
+    receive(OTHER_PORT, 10, 2);
+    assert(drain_analyzer() == 0);
+
+    assert(mirror_session_destroy(id) == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_mirror_vlan");
+}
+
+void test_mirror_rspan_truncate() {
+    mirror_session_config_t config = { .dest_port = ANALYZER_PORT, .truncate_length = 64, .rspan = true,
+                                       .rspan_vlan = 300, .rspan_priority = 5 };
+    mirror_session_stats_t stats;
+    uint8_t expected[FRAME_LEN];
+    packet_buffer_t *frame;
+    uint32_t id;
+
+    assert(mirror_session_create(&config, &id) == STATUS_SUCCESS);
+    assert(mirror_session_set_port(id, SOURCE_PORT, MIRROR_DIR_INGRESS) == STATUS_SUCCESS);
+    receive(SOURCE_PORT, 0, 1);
+    assert(drain_analyzer() == 1);
+
+    // The MACs, the RSPAN tag, then the truncated rest of the frame
+    frame = make_frame(SOURCE_PORT, 0);
+    assert(packet_peek_data(frame, 0, expected, FRAME_LEN) == STATUS_SUCCESS);
+    packet_buffer_free(frame);
+    assert(g_capture.lengths[0] == 64 + 4);
+    assert(memcmp(g_capture.frames[0], expected, 12) == 0);
+    assert(g_capture.frames[0][12] == 0x81 && g_capture.frames[0][13] == 0x00);
+    assert(g_capture.frames[0][14] == ((5 << 5) | (300 >> 8)) && g_capture.frames[0][15] == (300 & 0xFF));
+    assert(memcmp(g_capture.frames[0] + 16, expected + 12, 64 - 12) == 0);
+
+    assert(mirror_session_get_stats(id, &stats) == STATUS_SUCCESS);
+    assert(stats.mirrored == 1 && stats.mirrored_bytes == 64 + 4);
+
+    assert(mirror_session_destroy(id) == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_mirror_rspan_truncate");
+}
+
+void test_mirror_sampling() {
+    mirror_session_config_t config = { .dest_port = ANALYZER_PORT, .sample_rate = 4 };
+    mirror_session_stats_t stats;
+    uint32_t id;
+
+    assert(mirror_session_create(&config, &id) == STATUS_SUCCESS);
+    assert(mirror_session_set_port(id, SOURCE_PORT, MIRROR_DIR_INGRESS) == STATUS_SUCCESS);
+
+    // One frame in four is copied
+    receive(SOURCE_PORT, 0, 12);
+    assert(drain_analyzer() == 3);
+    assert(mirror_session_get_stats(id, &stats) == STATUS_SUCCESS);
+    assert(stats.mirrored == 3 && stats.sampled_out == 9);
+
+    assert(mirror_session_destroy(id) == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_mirror_sampling");
+}
+
+int main() {
+    port_config_t port_config;
+
+    printf("Running mirror unit tests...\n");
+
+    assert(packet_init() == STATUS_SUCCESS);
+    assert(hw_sim_init() == STATUS_SUCCESS);
+    assert(mirror_init() == STATUS_SUCCESS);
+    assert(mirror_init() == STATUS_ALREADY_INITIALIZED);
+
+    g_capture.drv.ops = &g_capture_ops;
+    g_capture.drv.flags = DRIVER_FLAG_TX_CAPABLE;
+    assert(hw_sim_get_port_config(ANALYZER_PORT, &port_config) == STATUS_SUCCESS);
+    port_config.driver = &g_capture.drv;
+    assert(hw_sim_set_port_config(ANALYZER_PORT, &port_config) == STATUS_SUCCESS);
+
+    test_mirror_session();
+    test_mirror_span();
+    test_mirror_vlan();
+    test_mirror_rspan_truncate();
+    test_mirror_sampling();
+
+    assert(mirror_cleanup() == STATUS_SUCCESS);
+    assert(mirror_cleanup() == STATUS_NOT_INITIALIZED);
+    assert(hw_sim_shutdown() == STATUS_SUCCESS);
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All mirror tests completed successfully.\n");
+    return 0;
+}
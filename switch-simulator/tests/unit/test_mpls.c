@@ -0,0 +1,319 @@
+/**
+ * @file test_mpls.c
+ * @brief Unit tests for MPLS label switching
+ *
+ * Labeled frames run through the ingress pipeline; what the stage queues
+ * on the egress port is recorded by a capture driver and checked byte for
+ * byte once its TX ring is drained.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/l3/mpls.h"
+#include "../../include/hal/hw_simulation.h"
+#include "../../include/hal/hw_resources.h"
+#include "../../include/hal/packet.h"
+#include "../../include/hal/port.h"
+#include "../../include/hal/driver.h"
+#include "../../include/common/config.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define INGRESS_PORT 1
+#define EGRESS_PORT 5
+#define IP_LEN 40
+#define FRAME_MAX 128
+#define CAPTURE_MAX 8
+#define TC 5
+#define TTL 64
+
+/* Frames the egress port sent */
+typedef struct {
+    driver_t drv;
+    uint32_t count;
+    uint32_t lengths[CAPTURE_MAX];
+    uint8_t frames[CAPTURE_MAX][FRAME_MAX];
+} capture_t;
+
+static capture_t g_capture;
+static const mac_addr_t g_next_hop = { .addr = { 0x02, 0, 0, 0, 0, 0x99 } };
+
+static uint16_t capture_transmit_burst(driver_t *drv, packet_t **pkts, uint16_t n) {
+    capture_t *capture = (capture_t *)drv;
+
+    for (uint16_t i = 0; i < n; i++) {
+        uint32_t len = packet_chain_length(pkts[i]);
+
+        assert(capture->count < CAPTURE_MAX && len <= sizeof(capture->frames[0]));
+        assert(packet_peek_data(pkts[i], 0, capture->frames[capture->count], len) == STATUS_SUCCESS);
+        capture->lengths[capture->count++] = len;
+    }
+    return n;
+}
+
+static const driver_ops_t g_capture_ops = { .transmit_burst = capture_transmit_burst };
+
+static uint32_t get32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t lse(uint32_t label, uint32_t tc, bool bos, uint32_t ttl) {
+    return (label << 12) | (tc << 9) | (bos ? 0x100u : 0) | ttl;
+}
+
+/* Build a labeled frame over an IPv4 packet; returns its length */
+static uint32_t build_frame(uint8_t *frame, const uint32_t *labels, uint32_t count, uint32_t ttl) {
+    static const uint8_t macs[12] = { 0x02, 0, 0, 0, 0, 0x01, 0x02, 0, 0, 0, 0, 0xaa };
+    uint8_t *p = frame + 14;
+
+    memcpy(frame, macs, sizeof(macs));
+    frame[12] = 0x88;
+    frame[13] = 0x47;
+    for (uint32_t i = 0; i < count; i++, p += 4) {
+        uint32_t v = lse(labels[i], TC, i == count - 1, ttl);
+
+        p[0] = (uint8_t)(v >> 24);
+        p[1] = (uint8_t)(v >> 16);
+        p[2] = (uint8_t)(v >> 8);
+        p[3] = (uint8_t)v;
+    }
+    for (uint32_t i = 0; i < IP_LEN; i++) {
+        p[i] = (uint8_t)(0x40 + i);
+    }
+    p[0] = 0x45;
+    return 14 + count * 4 + IP_LEN;
+}
+
+/* Run one frame through the ingress pipeline and return its result */
+static packet_result_t receive(const uint32_t *labels, uint32_t count, uint32_t ttl, packet_buffer_t **out) {
+    uint8_t frame[FRAME_MAX];
+    uint32_t len = build_frame(frame, labels, count, ttl);
+    packet_buffer_t *packet = packet_buffer_alloc(len);
+    packet_result_t result;
+
+    assert(packet != NULL);
+    assert(packet_append_data(packet, frame, len) == STATUS_SUCCESS);
+    packet->metadata.port = INGRESS_PORT;
+    assert(packet_process_burst(&packet, 1, &result) == STATUS_SUCCESS);
+    if (result == PACKET_RESULT_CONSUME) {
+        packet = NULL;
+    } else if (!out) {
+        packet_buffer_free(packet);
+        packet = NULL;
+    }
+    if (out) {
+        *out = packet;
+    }
+    return result;
+}
+
+/* Send what the egress port has queued and return how many frames left */
+static uint32_t drain_egress(void) {
+    g_capture.count = 0;
+    hw_sim_tx_drain(EGRESS_PORT, 64);
+    return g_capture.count;
+}
+
+/* Check the Ethernet header written for the next hop */
+static void check_eth(const uint8_t *frame, uint16_t ethertype) {
+    mac_addr_t src;
+
+    assert(port_get_mac(EGRESS_PORT, &src) == STATUS_SUCCESS);
+    assert(memcmp(frame, g_next_hop.addr, 6) == 0 && memcmp(frame + 6, src.addr, 6) == 0);
+    assert(((frame[12] << 8) | frame[13]) == ethertype);
+}
+
+void test_mpls_lfib() {
+    mpls_lfib_entry_t entry = { .action = MPLS_ACTION_SWAP, .out_labels = { 200 }, .out_count = 1,
+                                .egress_port = EGRESS_PORT, .next_hop_mac = g_next_hop };
+    mpls_lfib_entry_t got;
+    mpls_stats_t stats;
+
+    assert(mpls_lfib_set(100, &entry) == STATUS_NOT_INITIALIZED);
+    assert(mpls_get_stats(&stats) == STATUS_NOT_INITIALIZED);
+    assert(mpls_lfib_count() == 0);
+    assert(mpls_init() == STATUS_SUCCESS);
+    assert(mpls_init() == STATUS_ALREADY_INITIALIZED);
+
+    // Reserved labels have no entry, and the out labels must fit
+    assert(mpls_lfib_set(MPLS_LABEL_RESERVED_MAX, &entry) == STATUS_INVALID_PARAMETER);
+    assert(mpls_lfib_set(CONFIG_MPLS_LABEL_SPACE, &entry) == STATUS_INVALID_PARAMETER);
+    assert(mpls_lfib_set(100, NULL) == STATUS_INVALID_PARAMETER);
+    entry.out_count = 0;
+    assert(mpls_lfib_set(100, &entry) == STATUS_INVALID_PARAMETER);
+    entry.out_count = MPLS_MAX_OUT_LABELS + 1;
+    assert(mpls_lfib_set(100, &entry) == STATUS_INVALID_PARAMETER);
+    entry.out_count = 1;
+    entry.out_labels[0] = MPLS_LABEL_IMPLICIT_NULL;
+    assert(mpls_lfib_set(100, &entry) == STATUS_INVALID_PARAMETER);
+    entry.out_labels[0] = MPLS_LABEL_MAX + 1;
+    assert(mpls_lfib_set(100, &entry) == STATUS_INVALID_PARAMETER);
+    entry.out_labels[0] = 200;
+    entry.egress_port = PORT_ID_INVALID;
+    assert(mpls_lfib_set(100, &entry) == STATUS_INVALID_PARAMETER);
+    entry.egress_port = EGRESS_PORT;
+    entry.action = MPLS_ACTION_POP;
+    assert(mpls_lfib_set(100, &entry) == STATUS_INVALID_PARAMETER);
+    entry.action = MPLS_ACTION_SWAP;
+
+    // Replacing an entry keeps the count
+    assert(mpls_lfib_set(100, &entry) == STATUS_SUCCESS);
+    entry.out_labels[0] = 201;
+    assert(mpls_lfib_set(100, &entry) == STATUS_SUCCESS);
+    assert(mpls_lfib_count() == 1);
+    assert(mpls_lfib_get(100, &got) == STATUS_SUCCESS);
+    assert(got.action == MPLS_ACTION_SWAP && got.out_labels[0] == 201 && got.egress_port == EGRESS_PORT);
+    assert(mpls_lfib_get(101, &got) == STATUS_NOT_FOUND);
+    assert(mpls_lfib_get(100, NULL) == STATUS_INVALID_PARAMETER);
+
+    assert(mpls_lfib_delete(100) == STATUS_SUCCESS);
+    assert(mpls_lfib_delete(100) == STATUS_NOT_FOUND);
+    assert(mpls_lfib_count() == 0);
+
+    printf(TEST_PASSED, "test_mpls_lfib");
+}
+
+void test_mpls_swap_push() {
+    mpls_lfib_entry_t swap = { .action = MPLS_ACTION_SWAP, .out_labels = { 200 }, .out_count = 1,
+                               .egress_port = EGRESS_PORT, .next_hop_mac = g_next_hop };
+    mpls_lfib_entry_t push = { .action = MPLS_ACTION_PUSH, .out_labels = { 300, 301 }, .out_count = 2,
+                               .egress_port = EGRESS_PORT, .next_hop_mac = g_next_hop };
+    uint32_t labels[2] = { 100, 500 };
+    uint8_t expect[FRAME_MAX];
+    mpls_stats_t stats;
+    const uint8_t *p;
+
+    assert(mpls_lfib_set(100, &swap) == STATUS_SUCCESS);
+    assert(mpls_lfib_set(101, &push) == STATUS_SUCCESS);
+
+    // Swap: the top label changes and the TTL drops, the rest is untouched
+    assert(receive(labels, 2, TTL, NULL) == PACKET_RESULT_CONSUME);
+    assert(drain_egress() == 1);
+    assert(g_capture.lengths[0] == build_frame(expect, labels, 2, TTL));
+    p = g_capture.frames[0];
+    check_eth(p, ETHERTYPE_MPLS);
+    assert(get32(p + 14) == lse(200, TC, false, TTL - 1));
+    assert(memcmp(p + 18, expect + 18, 4 + IP_LEN) == 0);
+
+    // Push: two labels on top of the received one, which keeps its bottom of stack bit
+    labels[0] = 101;
+    assert(receive(labels, 1, TTL, NULL) == PACKET_RESULT_CONSUME);
+    assert(drain_egress() == 1);
+    assert(g_capture.lengths[0] == build_frame(expect, labels, 1, TTL) + 8);
+    p = g_capture.frames[0];
+    check_eth(p, ETHERTYPE_MPLS);
+    assert(get32(p + 14) == lse(300, TC, false, TTL - 1));
+    assert(get32(p + 18) == lse(301, TC, false, TTL - 1));
+    assert(get32(p + 22) == lse(101, TC, true, TTL - 1));
+    assert(memcmp(p + 26, expect + 18, IP_LEN) == 0);
+
+    assert(mpls_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.swapped == 1 && stats.pushed == 1 && stats.tx_drops == 0);
+
+    printf(TEST_PASSED, "test_mpls_swap_push");
+}
+
+void test_mpls_pop() {
+    mpls_lfib_entry_t php = { .action = MPLS_ACTION_POP, .egress_port = EGRESS_PORT,
+                              .next_hop_mac = g_next_hop };
+    mpls_lfib_entry_t local = { .action = MPLS_ACTION_POP, .egress_port = PORT_ID_INVALID };
+    uint32_t labels[2] = { 102, 500 };
+    uint8_t expect[FRAME_MAX];
+    packet_buffer_t *packet;
+    mpls_stats_t stats;
+
+    assert(mpls_lfib_set(102, &php) == STATUS_SUCCESS);
+    assert(mpls_lfib_set(103, &local) == STATUS_SUCCESS);
+
+    // Penultimate hop: the rest of the stack goes on with the TTL it had
+    assert(receive(labels, 2, TTL, NULL) == PACKET_RESULT_CONSUME);
+    assert(drain_egress() == 1);
+    build_frame(expect, labels, 2, TTL);
+    check_eth(g_capture.frames[0], ETHERTYPE_MPLS);
+    assert(g_capture.lengths[0] == 14 + 4 + IP_LEN);
+    assert(memcmp(g_capture.frames[0] + 14, expect + 18, 4 + IP_LEN) == 0);
+
+    // Popping the bottom of the stack sends the IP packet
+    assert(receive(labels, 1, TTL, NULL) == PACKET_RESULT_CONSUME);
+    assert(drain_egress() == 1);
+    check_eth(g_capture.frames[0], ETHERTYPE_IP);
+    assert(g_capture.lengths[0] == 14 + IP_LEN);
+    assert(memcmp(g_capture.frames[0] + 14, expect + 22, IP_LEN) == 0);
+
+    // Egress LSR: a pop without a next hop, then explicit null, leave an IP frame
+    labels[0] = 103;
+    labels[1] = MPLS_LABEL_IPV4_NULL;
+    assert(receive(labels, 2, TTL, &packet) == PACKET_RESULT_FORWARD);
+    build_frame(expect, labels, 2, TTL);
+    assert(packet_chain_length(packet) == 14 + IP_LEN);
+    assert(memcmp(packet->data, expect, 12) == 0);
+    assert(packet->data[12] == 0x08 && packet->data[13] == 0x00);
+    assert(memcmp(packet->data + 14, expect + 22, IP_LEN) == 0);
+    assert(packet_has_proto(packet, PACKET_PROTO_IPV4) && !packet_has_proto(packet, PACKET_PROTO_MPLS));
+    packet_buffer_free(packet);
+    assert(drain_egress() == 0);
+
+    assert(mpls_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.popped == 2 && stats.terminated == 1);
+
+    printf(TEST_PASSED, "test_mpls_pop");
+}
+
+void test_mpls_drops() {
+    uint32_t labels[1] = { 100 };
+    mpls_stats_t before, after;
+
+    assert(mpls_get_stats(&before) == STATUS_SUCCESS);
+
+    assert(receive(labels, 1, 1, NULL) == PACKET_RESULT_DROP);
+    labels[0] = 999;
+    assert(receive(labels, 1, TTL, NULL) == PACKET_RESULT_DROP);
+    labels[0] = MPLS_LABEL_ROUTER_ALERT;
+    assert(receive(labels, 1, TTL, NULL) == PACKET_RESULT_DROP);
+    assert(drain_egress() == 0);
+
+    // A deleted label is unknown from then on
+    assert(mpls_lfib_delete(100) == STATUS_SUCCESS);
+    labels[0] = 100;
+    assert(receive(labels, 1, TTL, NULL) == PACKET_RESULT_DROP);
+
+    assert(mpls_get_stats(&after) == STATUS_SUCCESS);
+    assert(after.ttl_expired == before.ttl_expired + 1);
+    assert(after.unknown_label == before.unknown_label + 2);
+    assert(after.reserved_label == before.reserved_label + 1);
+    assert(after.swapped == before.swapped);
+
+    printf(TEST_PASSED, "test_mpls_drops");
+}
+
+int main() {
+    port_config_t port_config;
+
+    printf("Running MPLS unit tests...\n");
+
+    assert(packet_init() == STATUS_SUCCESS);
+    assert(hw_sim_init() == STATUS_SUCCESS);
+
+    g_capture.drv.ops = &g_capture_ops;
+    g_capture.drv.flags = DRIVER_FLAG_TX_CAPABLE;
+    assert(hw_sim_get_port_config(EGRESS_PORT, &port_config) == STATUS_SUCCESS);
+    port_config.driver = &g_capture.drv;
+    assert(hw_sim_set_port_config(EGRESS_PORT, &port_config) == STATUS_SUCCESS);
+
+    test_mpls_lfib();
+    test_mpls_swap_push();
+    test_mpls_pop();
+    test_mpls_drops();
+
+    assert(mpls_cleanup() == STATUS_SUCCESS);
+    assert(mpls_cleanup() == STATUS_NOT_INITIALIZED);
+    assert(hw_sim_shutdown() == STATUS_SUCCESS);
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All MPLS tests completed successfully.\n");
+    return 0;
+}
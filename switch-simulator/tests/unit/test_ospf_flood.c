@@ -0,0 +1,279 @@
+/**
+ * @file test_ospf_flood.c
+ * @brief Unit tests for packed OSPF update and ack transmission
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/l3/ospf_flood.h"
+#include "../../include/common/event_loop.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define MAX_SENT 32
+#define MAX_PACKET 512
+#define LSA_LEN 40
+#define TEST_MTU 200                /* Three 40-byte LSAs or seven ack headers a packet */
+#define ROUTER_ID 0x01010101
+#define NEIGHBOR 0x0A000002
+
+typedef struct {
+    uint32_t dst;
+    uint16_t length;
+    uint8_t data[MAX_PACKET];
+} sent_packet_t;
+
+static sent_packet_t g_sent[MAX_SENT];
+static uint32_t g_sent_count;
+
+static status_t capture(uint32_t dst, const uint8_t *packet, uint16_t length, void *ctx) {
+    (void)ctx;
+
+    assert(g_sent_count < MAX_SENT && length <= MAX_PACKET);
+    g_sent[g_sent_count].dst = dst;
+    g_sent[g_sent_count].length = length;
+    memcpy(g_sent[g_sent_count].data, packet, length);
+    g_sent_count++;
+    return STATUS_SUCCESS;
+}
+
+static uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return (uint32_t)get16(p) << 16 | get16(p + 2);
+}
+
+static void make_lsa(uint8_t *lsa, uint32_t ls_id, uint32_t seq, uint16_t age) {
+    memset(lsa, 0, LSA_LEN);
+    lsa[0] = (uint8_t)(age >> 8);
+    lsa[1] = (uint8_t)age;
+    lsa[3] = 1;
+    lsa[4] = (uint8_t)(ls_id >> 24); lsa[5] = (uint8_t)(ls_id >> 16);
+    lsa[6] = (uint8_t)(ls_id >> 8); lsa[7] = (uint8_t)ls_id;
+    lsa[8] = 0x02; lsa[9] = 0x02; lsa[10] = 0x02; lsa[11] = 0x02;
+    lsa[12] = (uint8_t)(seq >> 24); lsa[13] = (uint8_t)(seq >> 16);
+    lsa[14] = (uint8_t)(seq >> 8); lsa[15] = (uint8_t)seq;
+    lsa[19] = LSA_LEN;
+}
+
+/* A finished packet: OSPF header filled in and checksum over all of it */
+static void check_packet(const sent_packet_t *pkt, uint8_t type) {
+    uint32_t sum = 0;
+
+    assert(pkt->data[0] == 2 && pkt->data[1] == type);
+    assert(get16(pkt->data + 2) == pkt->length);
+    assert(get32(pkt->data + 4) == ROUTER_ID);
+    assert(pkt->length <= TEST_MTU - OSPF_FLOOD_IP_OVERHEAD);
+    for (uint16_t i = 0; i + 1 < pkt->length; i += 2) {
+        sum += get16(pkt->data + i);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    assert(sum == 0xFFFF);
+}
+
+static void init_tx(ospf_flood_tx_t *tx, uint32_t pacing_ms) {
+    ospf_flood_config_t config = {
+        .router_id = ROUTER_ID,
+        .area_id = 0,
+        .mtu = TEST_MTU,
+        .transmit_delay = 1,
+        .pacing_ms = pacing_ms,
+        .ack_delay_ms = 1000,
+        .send = capture,
+    };
+
+    g_sent_count = 0;
+    assert(ospf_flood_init(tx, &config) == STATUS_SUCCESS);
+}
+
+static void stop_loop(event_timer_t *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+    event_loop_stop();
+}
+
+void test_ospf_flood_config() {
+    ospf_flood_tx_t tx;
+    ospf_flood_config_t config = { .router_id = ROUTER_ID, .mtu = TEST_MTU, .send = NULL };
+
+    assert(ospf_flood_init(&tx, &config) == STATUS_INVALID_PARAMETER);
+    config.send = capture;
+    config.mtu = OSPF_FLOOD_IP_OVERHEAD + OSPF_FLOOD_HEADER_LEN + OSPF_FLOOD_LSA_HEADER_LEN;
+    assert(ospf_flood_init(&tx, &config) == STATUS_INVALID_PARAMETER);
+    config.mtu = TEST_MTU;
+    assert(ospf_flood_init(&tx, &config) == STATUS_SUCCESS);
+    assert(ospf_flood_lsa(&tx, NULL, LSA_LEN) == STATUS_INVALID_PARAMETER);
+    ospf_flood_destroy(&tx);
+
+    printf(TEST_PASSED, "test_ospf_flood_config");
+}
+
+void test_ospf_flood_packing() {
+    ospf_flood_tx_t tx;
+    ospf_flood_stats_t stats;
+    uint8_t lsa[LSA_LEN];
+
+    init_tx(&tx, 1000);
+
+    // Seven LSAs: two full updates leave at once, the third waits
+    for (uint32_t i = 0; i < 7; i++) {
+        make_lsa(lsa, 0x0A000000 + i, 0x80000001, 10);
+        assert(ospf_flood_lsa(&tx, lsa, LSA_LEN) == STATUS_SUCCESS);
+    }
+    assert(g_sent_count == 2);
+    ospf_flood_flush(&tx);
+    assert(g_sent_count == 3);
+
+    for (uint32_t i = 0; i < 3; i++) {
+        check_packet(&g_sent[i], 4);
+        assert(g_sent[i].dst == OSPF_FLOOD_ALLSPFROUTERS);
+    }
+    assert(get32(g_sent[0].data + OSPF_FLOOD_HEADER_LEN) == 3);
+    assert(get32(g_sent[2].data + OSPF_FLOOD_HEADER_LEN) == 1);
+
+    // Each LSA is aged by InfTransDelay on the way out
+    assert(get16(g_sent[0].data + OSPF_FLOOD_HEADER_LEN + 4) == 11);
+    assert(get32(g_sent[0].data + OSPF_FLOOD_HEADER_LEN + 4 + 4) == 0x0A000000);
+
+    assert(ospf_flood_get_stats(&tx, &stats) == STATUS_SUCCESS);
+    assert(stats.lsu_packets == 3 && stats.lsas == 7);
+
+    ospf_flood_destroy(&tx);
+    printf(TEST_PASSED, "test_ospf_flood_packing");
+}
+
+void test_ospf_flood_coalesce() {
+    ospf_flood_tx_t tx;
+    ospf_flood_stats_t stats;
+    uint8_t lsa[LSA_LEN];
+    uint8_t other[LSA_LEN];
+
+    init_tx(&tx, 1000);
+
+    // A newer instance replaces the queued one instead of riding along
+    make_lsa(lsa, 0x0A000001, 0x80000001, 0);
+    make_lsa(other, 0x0A000002, 0x80000001, 0);
+    assert(ospf_flood_lsa(&tx, lsa, LSA_LEN) == STATUS_SUCCESS);
+    assert(ospf_flood_lsa(&tx, other, LSA_LEN) == STATUS_SUCCESS);
+    make_lsa(lsa, 0x0A000001, 0x80000002, 0);
+    assert(ospf_flood_lsa(&tx, lsa, LSA_LEN) == STATUS_SUCCESS);
+    ospf_flood_flush(&tx);
+
+    assert(g_sent_count == 1);
+    assert(get32(g_sent[0].data + OSPF_FLOOD_HEADER_LEN) == 2);
+    assert(get32(g_sent[0].data + OSPF_FLOOD_HEADER_LEN + 4 + 4) == 0x0A000002);
+    assert(get32(g_sent[0].data + OSPF_FLOOD_HEADER_LEN + 4 + LSA_LEN + 12) == 0x80000002);
+
+    // Retransmissions to a neighbor are packed apart from the flood
+    assert(ospf_flood_send_lsa(&tx, NEIGHBOR, lsa, LSA_LEN) == STATUS_SUCCESS);
+    assert(ospf_flood_lsa(&tx, other, LSA_LEN) == STATUS_SUCCESS);
+    ospf_flood_flush(&tx);
+    assert(g_sent_count == 3);
+    assert((g_sent[1].dst == NEIGHBOR) != (g_sent[2].dst == NEIGHBOR));
+
+    assert(ospf_flood_get_stats(&tx, &stats) == STATUS_SUCCESS);
+    assert(stats.coalesced == 1 && stats.lsas == 4);
+
+    ospf_flood_destroy(&tx);
+    printf(TEST_PASSED, "test_ospf_flood_coalesce");
+}
+
+void test_ospf_flood_acks() {
+    ospf_flood_tx_t tx;
+    ospf_flood_stats_t stats;
+    uint8_t lsa[LSA_LEN];
+    uint32_t i;
+
+    init_tx(&tx, 1000);
+
+    // Delayed acks share packets to the flood address, seven headers each
+    for (i = 0; i < 9; i++) {
+        make_lsa(lsa, 0x0A000000 + i, 0x80000001, 0);
+        assert(ospf_flood_ack(&tx, NEIGHBOR, lsa, true) == STATUS_SUCCESS);
+    }
+    // The same instance is acknowledged once
+    assert(ospf_flood_ack(&tx, NEIGHBOR, lsa, true) == STATUS_SUCCESS);
+    assert(g_sent_count == 1);
+
+    // A direct ack goes to its neighbor
+    assert(ospf_flood_ack(&tx, NEIGHBOR, lsa, false) == STATUS_SUCCESS);
+
+    // A DROther floods to AllDRouters; acks delayed for the old address leave first
+    ospf_flood_set_flood_address(&tx, OSPF_FLOOD_ALLDROUTERS);
+    assert(g_sent_count == 2);
+    assert(g_sent[0].dst == OSPF_FLOOD_ALLSPFROUTERS && g_sent[1].dst == OSPF_FLOOD_ALLSPFROUTERS);
+    check_packet(&g_sent[0], 5);
+    assert(g_sent[0].length == OSPF_FLOOD_HEADER_LEN + 7 * OSPF_FLOOD_LSA_HEADER_LEN);
+    assert(g_sent[1].length == OSPF_FLOOD_HEADER_LEN + 2 * OSPF_FLOOD_LSA_HEADER_LEN);
+
+    ospf_flood_flush(&tx);
+    assert(g_sent_count == 3);
+    assert(g_sent[2].dst == NEIGHBOR);
+
+    make_lsa(lsa, 0x0A000001, 0x80000001, 0);
+    assert(ospf_flood_lsa(&tx, lsa, LSA_LEN) == STATUS_SUCCESS);
+    ospf_flood_flush(&tx);
+    assert(g_sent[3].dst == OSPF_FLOOD_ALLDROUTERS);
+
+    assert(ospf_flood_get_stats(&tx, &stats) == STATUS_SUCCESS);
+    assert(stats.ack_packets == 3 && stats.acks == 10 && stats.coalesced == 1);
+
+    ospf_flood_destroy(&tx);
+    printf(TEST_PASSED, "test_ospf_flood_acks");
+}
+
+void test_ospf_flood_pacing() {
+    ospf_flood_tx_t tx;
+    event_timer_t stop;
+    uint8_t lsa[LSA_LEN];
+
+    init_tx(&tx, 5);
+
+    // Updates within the pacing window leave together when it closes
+    make_lsa(lsa, 0x0A000001, 0x80000001, 0);
+    assert(ospf_flood_lsa(&tx, lsa, LSA_LEN) == STATUS_SUCCESS);
+    make_lsa(lsa, 0x0A000002, 0x80000001, 0);
+    assert(ospf_flood_lsa(&tx, lsa, LSA_LEN) == STATUS_SUCCESS);
+    assert(g_sent_count == 0);
+
+    event_timer_init(&stop, stop_loop, NULL);
+    assert(event_timer_start(&stop, 50000, 0) == STATUS_SUCCESS);
+    assert(event_loop_run() == STATUS_SUCCESS);
+    assert(g_sent_count == 1);
+    assert(get32(g_sent[0].data + OSPF_FLOOD_HEADER_LEN) == 2);
+
+    ospf_flood_destroy(&tx);
+
+    // With no pacing window every update leaves at once
+    init_tx(&tx, 0);
+    assert(ospf_flood_lsa(&tx, lsa, LSA_LEN) == STATUS_SUCCESS);
+    assert(g_sent_count == 1);
+    ospf_flood_destroy(&tx);
+
+    printf(TEST_PASSED, "test_ospf_flood_pacing");
+}
+
+int main() {
+    printf("Running OSPF flooding unit tests...\n");
+
+    assert(event_loop_init() == STATUS_SUCCESS);
+
+    test_ospf_flood_config();
+    test_ospf_flood_packing();
+    test_ospf_flood_coalesce();
+    test_ospf_flood_acks();
+    test_ospf_flood_pacing();
+
+    assert(event_loop_shutdown() == STATUS_SUCCESS);
+
+    printf("All OSPF flooding tests completed successfully.\n");
+    return 0;
+}
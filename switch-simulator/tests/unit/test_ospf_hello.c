@@ -0,0 +1,337 @@
+/**
+ * @file test_ospf_hello.c
+ * @brief Unit tests for OSPF Hello transmission and neighbor inactivity
+ *
+ * The event loop runs on the virtual clock, so intervals of seconds pass
+ * at once and the times the Hellos leave are known to the tick.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <arpa/inet.h>
+#include "../../include/l3/ospf_hello.h"
+#include "../../include/common/event_loop.h"
+#include "../../include/common/sim_clock.h"
+#include "../../include/common/config.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define SEC 1000000ULL
+#define MAX_SENT 64
+#define ROUTER_ID 0x01010101
+#define AREA_ID 0x00000001
+#define MASK 0xFFFFFF00
+#define HELLO_INTERVAL 10
+#define DEAD_INTERVAL 40
+#define PRIORITY 1
+#define NBR_ID 0x02020202
+#define NBR_IP 0x0A000002
+
+typedef struct {
+    uint32_t count;
+    uint64_t at_us[MAX_SENT];
+    uint32_t dst;
+    uint8_t last[OSPF_HELLO_MAX_LEN];
+    uint16_t last_len;
+    status_t result;
+} sent_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t router_id;
+    uint32_t neighbor_ip;
+} dead_t;
+
+static event_timer_t g_stop;
+static ospf_hello_iface_t g_iface;
+static sent_t g_sent;
+static dead_t g_dead;
+
+static void stop_loop(event_timer_t *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+    event_loop_stop();
+}
+
+static void run_for(uint64_t us) {
+    assert(event_timer_start(&g_stop, us, 0) == STATUS_SUCCESS);
+    assert(event_loop_run() == STATUS_SUCCESS);
+}
+
+static status_t capture_send(uint32_t dst, const uint8_t *packet, uint16_t length, void *ctx) {
+    sent_t *sent = ctx;
+
+    assert(length <= OSPF_HELLO_MAX_LEN);
+    if (sent->count < MAX_SENT) {
+        sent->at_us[sent->count] = event_loop_now_us();
+    }
+    sent->count++;
+    sent->dst = dst;
+    memcpy(sent->last, packet, length);
+    sent->last_len = length;
+    return sent->result;
+}
+
+static void capture_dead(uint32_t router_id, uint32_t neighbor_ip, void *ctx) {
+    (void)ctx;
+    g_dead.count++;
+    g_dead.router_id = router_id;
+    g_dead.neighbor_ip = neighbor_ip;
+}
+
+static ospf_hello_config_t make_config(uint8_t jitter_pct) {
+    ospf_hello_config_t config;
+
+    memset(&config, 0, sizeof(config));
+    config.router_id = ROUTER_ID;
+    config.area_id = AREA_ID;
+    config.network_mask = MASK;
+    config.hello_interval = HELLO_INTERVAL;
+    config.dead_interval = DEAD_INTERVAL;
+    config.options = 0x02;
+    config.priority = PRIORITY;
+    config.jitter_pct = jitter_pct;
+    config.send = capture_send;
+    config.dead = capture_dead;
+    config.ctx = &g_sent;
+    return config;
+}
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return ntohl(v);
+}
+
+static uint16_t read16(const uint8_t *p) {
+    uint16_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return ntohs(v);
+}
+
+/* One's complement sum over the packet, 0xFFFF when the checksum is right */
+static uint16_t checksum_fold(const uint8_t *data, uint16_t len) {
+    uint32_t sum = 0;
+
+    for (uint16_t i = 0; i + 1 < len; i += 2) {
+        sum += (uint32_t)(data[i] << 8 | data[i + 1]);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+void test_ospf_hello_config() {
+    ospf_hello_config_t config = make_config(0);
+
+    config.send = NULL;
+    assert(ospf_hello_init(&g_iface, &config) == STATUS_INVALID_PARAMETER);
+    config = make_config(0);
+    config.hello_interval = 0;
+    assert(ospf_hello_init(&g_iface, &config) == STATUS_INVALID_PARAMETER);
+    config = make_config(0);
+    config.dead_interval = HELLO_INTERVAL;
+    assert(ospf_hello_init(&g_iface, &config) == STATUS_INVALID_PARAMETER);
+    config = make_config(51);
+    assert(ospf_hello_init(&g_iface, &config) == STATUS_INVALID_PARAMETER);
+    assert(ospf_hello_init(NULL, &config) == STATUS_INVALID_PARAMETER);
+    assert(ospf_hello_start(NULL) == STATUS_INVALID_PARAMETER);
+    assert(ospf_hello_send_now(NULL) == STATUS_INVALID_PARAMETER);
+
+    config = make_config(50);
+    assert(ospf_hello_init(&g_iface, &config) == STATUS_SUCCESS);
+    ospf_hello_destroy(&g_iface);
+
+    printf(TEST_PASSED, "test_ospf_hello_config");
+}
+
+void test_ospf_hello_template() {
+    ospf_hello_config_t config = make_config(0);
+    ospf_hello_stats_t stats;
+    const uint8_t *body = g_sent.last + OSPF_HELLO_HEADER_LEN;
+
+    memset(&g_sent, 0, sizeof(g_sent));
+    assert(ospf_hello_init(&g_iface, &config) == STATUS_SUCCESS);
+
+    // The packet says what the configuration says, to AllSPFRouters by default
+    assert(ospf_hello_send_now(&g_iface) == STATUS_SUCCESS);
+    assert(g_sent.count == 1 && g_sent.dst == OSPF_HELLO_ALLSPFROUTERS);
+    assert(g_sent.last_len == OSPF_HELLO_HEADER_LEN + OSPF_HELLO_BODY_LEN);
+    assert(g_sent.last[0] == 2 && g_sent.last[1] == 1);
+    assert(read16(g_sent.last + 2) == g_sent.last_len);
+    assert(read32(g_sent.last + 4) == ROUTER_ID && read32(g_sent.last + 8) == AREA_ID);
+    assert(checksum_fold(g_sent.last, g_sent.last_len) == 0xFFFF);
+    assert(read32(body) == MASK && read16(body + 4) == HELLO_INTERVAL);
+    assert(body[6] == 0x02 && body[7] == PRIORITY);
+    assert(read32(body + 8) == DEAD_INTERVAL);
+    assert(read32(body + 12) == 0 && read32(body + 16) == 0);
+
+    // Sending again reuses the template
+    assert(ospf_hello_send_now(&g_iface) == STATUS_SUCCESS);
+    assert(ospf_hello_get_stats(&g_iface, &stats) == STATUS_SUCCESS);
+    assert(stats.hellos_sent == 2 && stats.template_builds == 1);
+
+    // What the Hello carries rebuilds it; setting the same values does not
+    ospf_hello_set_priority(&g_iface, PRIORITY);
+    ospf_hello_set_dr(&g_iface, 0, 0);
+    assert(ospf_hello_send_now(&g_iface) == STATUS_SUCCESS);
+    assert(ospf_hello_get_stats(&g_iface, &stats) == STATUS_SUCCESS && stats.template_builds == 1);
+    ospf_hello_set_dr(&g_iface, 0x0A000001, NBR_IP);
+    ospf_hello_set_priority(&g_iface, 200);
+    assert(ospf_hello_received(&g_iface, NBR_ID, NBR_IP, NULL) == STATUS_SUCCESS);
+    assert(ospf_hello_send_now(&g_iface) == STATUS_SUCCESS);
+    assert(ospf_hello_get_stats(&g_iface, &stats) == STATUS_SUCCESS && stats.template_builds == 2);
+    assert(body[7] == 200);
+    assert(read32(body + 12) == 0x0A000001 && read32(body + 16) == NBR_IP);
+    assert(g_sent.last_len == OSPF_HELLO_HEADER_LEN + OSPF_HELLO_BODY_LEN + 4);
+    assert(read32(body + OSPF_HELLO_BODY_LEN) == NBR_ID);
+    assert(checksum_fold(g_sent.last, g_sent.last_len) == 0xFFFF);
+
+    // A refused send is counted and returned
+    g_sent.result = STATUS_FAILURE;
+    assert(ospf_hello_send_now(&g_iface) == STATUS_FAILURE);
+    assert(ospf_hello_get_stats(&g_iface, &stats) == STATUS_SUCCESS);
+    assert(stats.send_errors == 1 && stats.hellos_sent == 4);
+    g_sent.result = STATUS_SUCCESS;
+
+    ospf_hello_destroy(&g_iface);
+    assert(ospf_hello_get_stats(&g_iface, NULL) == STATUS_INVALID_PARAMETER);
+
+    printf(TEST_PASSED, "test_ospf_hello_template");
+}
+
+void test_ospf_hello_periodic() {
+    ospf_hello_config_t config = make_config(OSPF_HELLO_DEFAULT_JITTER_PCT);
+    const uint64_t interval = HELLO_INTERVAL * SEC;
+    const uint64_t window = interval * OSPF_HELLO_DEFAULT_JITTER_PCT / 100;
+    uint64_t start;
+    uint32_t count;
+
+    // The first Hello leaves within the jitter window, the next ones at most an interval apart
+    memset(&g_sent, 0, sizeof(g_sent));
+    assert(ospf_hello_init(&g_iface, &config) == STATUS_SUCCESS);
+    start = event_loop_now_us();
+    assert(ospf_hello_start(&g_iface) == STATUS_SUCCESS);
+    assert(ospf_hello_start(&g_iface) == STATUS_SUCCESS);
+    run_for(20 * interval);
+    assert(g_sent.count >= 20 && g_sent.count <= 23);
+    assert(g_sent.at_us[0] > start && g_sent.at_us[0] <= start + window);
+    for (uint32_t i = 1; i < g_sent.count; i++) {
+        uint64_t gap = g_sent.at_us[i] - g_sent.at_us[i - 1];
+        assert(gap > interval - window && gap <= interval + CONFIG_EVENT_LOOP_TICK_US);
+    }
+
+    // Stopped, it stays quiet
+    ospf_hello_stop(&g_iface);
+    count = g_sent.count;
+    run_for(3 * interval);
+    assert(g_sent.count == count);
+    ospf_hello_destroy(&g_iface);
+
+    // Without jitter the Hellos are an interval apart, give or take the loop's tick
+    config = make_config(0);
+    memset(&g_sent, 0, sizeof(g_sent));
+    assert(ospf_hello_init(&g_iface, &config) == STATUS_SUCCESS);
+    assert(ospf_hello_start(&g_iface) == STATUS_SUCCESS);
+    run_for(5 * interval + 1000);
+    assert(g_sent.count == 6);
+    for (uint32_t i = 1; i < g_sent.count; i++) {
+        uint64_t gap = g_sent.at_us[i] - g_sent.at_us[i - 1];
+        assert(gap >= interval && gap <= interval + CONFIG_EVENT_LOOP_TICK_US);
+    }
+    ospf_hello_destroy(&g_iface);
+
+    printf(TEST_PASSED, "test_ospf_hello_periodic");
+}
+
+void test_ospf_hello_inactivity() {
+    ospf_hello_config_t config = make_config(0);
+    ospf_hello_neighbor_t *nbr = NULL;
+    ospf_hello_neighbor_t *again = NULL;
+    ospf_hello_stats_t stats;
+
+    memset(&g_sent, 0, sizeof(g_sent));
+    memset(&g_dead, 0, sizeof(g_dead));
+    assert(ospf_hello_init(&g_iface, &config) == STATUS_SUCCESS);
+    assert(ospf_hello_received(&g_iface, 0, NBR_IP, NULL) == STATUS_INVALID_PARAMETER);
+    assert(ospf_hello_received(&g_iface, NBR_ID, NBR_IP, &nbr) == STATUS_SUCCESS);
+    assert(nbr != NULL);
+    assert(ospf_hello_received(&g_iface, NBR_ID, NBR_IP + 1, &again) == STATUS_SUCCESS);
+    assert(again == nbr);
+
+    // A Hello within the dead interval only moves the deadline
+    run_for(30 * SEC);
+    ospf_hello_neighbor_refresh(nbr);
+    run_for(15 * SEC);
+    assert(g_dead.count == 0);
+    assert(ospf_hello_get_stats(&g_iface, &stats) == STATUS_SUCCESS);
+    assert(stats.hellos_received == 2 && stats.inactivity_rearms == 1);
+
+    // Silence for the dead interval drops it and reports it
+    run_for(30 * SEC);
+    assert(g_dead.count == 1 && g_dead.router_id == NBR_ID && g_dead.neighbor_ip == NBR_IP + 1);
+    assert(ospf_hello_get_stats(&g_iface, &stats) == STATUS_SUCCESS);
+    assert(stats.neighbors_dead == 1 && stats.inactivity_rearms == 1);
+    assert(ospf_hello_remove_neighbor(&g_iface, NBR_ID) == STATUS_NOT_FOUND);
+
+    // The next Hello no longer lists it
+    assert(ospf_hello_send_now(&g_iface) == STATUS_SUCCESS);
+    assert(g_sent.last_len == OSPF_HELLO_HEADER_LEN + OSPF_HELLO_BODY_LEN);
+
+    printf(TEST_PASSED, "test_ospf_hello_inactivity");
+}
+
+void test_ospf_hello_neighbors() {
+    ospf_hello_stats_t stats;
+
+    // The interface holds a fixed number of neighbors
+    memset(&g_dead, 0, sizeof(g_dead));
+    for (uint32_t i = 0; i < OSPF_HELLO_MAX_NEIGHBORS; i++) {
+        assert(ospf_hello_received(&g_iface, NBR_ID + i, NBR_IP + i, NULL) == STATUS_SUCCESS);
+    }
+    assert(ospf_hello_received(&g_iface, NBR_ID + OSPF_HELLO_MAX_NEIGHBORS, NBR_IP, NULL) ==
+           STATUS_RESOURCE_EXHAUSTED);
+    assert(ospf_hello_send_now(&g_iface) == STATUS_SUCCESS);
+    assert(g_sent.last_len == OSPF_HELLO_MAX_LEN);
+
+    // A removed neighbor frees its place and is never reported dead
+    assert(ospf_hello_remove_neighbor(&g_iface, NBR_ID) == STATUS_SUCCESS);
+    assert(ospf_hello_remove_neighbor(NULL, NBR_ID) == STATUS_INVALID_PARAMETER);
+    assert(ospf_hello_received(&g_iface, NBR_ID + OSPF_HELLO_MAX_NEIGHBORS, NBR_IP, NULL) == STATUS_SUCCESS);
+
+    // Destroying the interface stops every timer
+    assert(ospf_hello_start(&g_iface) == STATUS_SUCCESS);
+    ospf_hello_destroy(&g_iface);
+    g_sent.count = 0;
+    run_for(2 * DEAD_INTERVAL * SEC);
+    assert(g_dead.count == 0 && g_sent.count == 0);
+    assert(ospf_hello_get_stats(&g_iface, &stats) == STATUS_SUCCESS && stats.neighbors_dead == 1);
+
+    printf(TEST_PASSED, "test_ospf_hello_neighbors");
+}
+
+int main() {
+    printf("Running OSPF Hello unit tests...\n");
+
+    assert(sim_clock_set_mode(SIM_CLOCK_VIRTUAL) == STATUS_SUCCESS);
+    assert(event_loop_init() == STATUS_SUCCESS);
+    event_timer_init(&g_stop, stop_loop, NULL);
+
+    test_ospf_hello_config();
+    test_ospf_hello_template();
+    test_ospf_hello_periodic();
+    test_ospf_hello_inactivity();
+    test_ospf_hello_neighbors();
+
+    assert(event_loop_shutdown() == STATUS_SUCCESS);
+
+    printf("All OSPF Hello tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,213 @@
+/**
+ * @file test_ospf_lsdb.c
+ * @brief Unit tests for the OSPF link state database
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/l3/ospf_lsdb.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define LSA_HEADER_LEN 20
+#define SELF_ID 0x01010101
+#define PEER_ID 0x02020202
+#define MANY_LSAS 2000
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    put16(p, (uint16_t)(v >> 16));
+    put16(p + 2, (uint16_t)v);
+}
+
+static void install(ospf_lsdb_t *db, uint8_t type, uint32_t ls_id, uint32_t adv_router, uint32_t seq,
+                    uint16_t age, uint32_t now) {
+    uint8_t lsa[LSA_HEADER_LEN + 4] = {0};
+
+    put16(lsa, age);
+    lsa[3] = type;
+    put32(lsa + 4, ls_id);
+    put32(lsa + 8, adv_router);
+    put32(lsa + 12, seq);
+    put16(lsa + 16, (uint16_t)(seq * 7));
+    put16(lsa + 18, sizeof(lsa));
+    assert(ospf_lsdb_install(db, lsa, sizeof(lsa), now) == STATUS_SUCCESS);
+}
+
+typedef struct {
+    uint32_t refreshes;
+    uint32_t max_ages;
+    uint32_t last_adv_router;
+    bool reinstall;                 /* Reoriginate refreshed LSAs */
+    bool flush;                     /* Remove LSAs at MaxAge */
+    uint32_t now;
+} aging_ctx_t;
+
+static void on_deadline(ospf_lsdb_t *db, const ospf_lsdb_entry_t *entry, ospf_lsdb_event_t event, void *arg) {
+    aging_ctx_t *ctx = arg;
+
+    ctx->last_adv_router = entry->adv_router;
+    if (event == OSPF_LSDB_EVENT_REFRESH) {
+        ctx->refreshes++;
+        if (ctx->reinstall) {
+            install(db, entry->ls_type, entry->ls_id, entry->adv_router, entry->seq + 1, 0, ctx->now);
+        }
+    } else {
+        ctx->max_ages++;
+        if (ctx->flush) {
+            assert(ospf_lsdb_remove(db, entry->ls_type, entry->ls_id, entry->adv_router) == STATUS_SUCCESS);
+        }
+    }
+}
+
+static bool count_lsa(const ospf_lsdb_entry_t *entry, void *arg) {
+    (void)entry;
+    (*(uint32_t *)arg)++;
+    return true;
+}
+
+static bool stop_at_first(const ospf_lsdb_entry_t *entry, void *arg) {
+    (void)entry;
+    (*(uint32_t *)arg)++;
+    return false;
+}
+
+void test_ospf_lsdb_install_lookup() {
+    ospf_lsdb_t *db = ospf_lsdb_create(SELF_ID, 0);
+    const ospf_lsdb_entry_t *entry;
+    uint8_t short_lsa[LSA_HEADER_LEN - 1] = {0};
+
+    assert(db != NULL);
+    install(db, 1, PEER_ID, PEER_ID, 0x80000001, 0, 0);
+    install(db, 2, 0x0A000001, PEER_ID, 0x80000001, 0, 0);
+    assert(ospf_lsdb_count(db) == 2);
+
+    entry = ospf_lsdb_lookup(db, 1, PEER_ID, PEER_ID);
+    assert(entry != NULL);
+    assert(entry->seq == 0x80000001 && entry->length == LSA_HEADER_LEN + 4);
+    assert(entry->data[3] == 1);
+
+    // The triple is the key: another type or router is another LSA
+    assert(ospf_lsdb_lookup(db, 1, PEER_ID, SELF_ID) == NULL);
+    assert(ospf_lsdb_lookup(db, 3, PEER_ID, PEER_ID) == NULL);
+
+    // A newer instance replaces the old one in place
+    install(db, 1, PEER_ID, PEER_ID, 0x80000002, 0, 10);
+    assert(ospf_lsdb_count(db) == 2);
+    entry = ospf_lsdb_lookup(db, 1, PEER_ID, PEER_ID);
+    assert(entry->seq == 0x80000002 && entry->install_time == 10);
+
+    assert(ospf_lsdb_remove(db, 1, PEER_ID, PEER_ID) == STATUS_SUCCESS);
+    assert(ospf_lsdb_remove(db, 1, PEER_ID, PEER_ID) == STATUS_NOT_FOUND);
+    assert(ospf_lsdb_count(db) == 1);
+
+    // Anything shorter than a header is refused
+    assert(ospf_lsdb_install(db, short_lsa, sizeof(short_lsa), 0) == STATUS_INVALID_PARAMETER);
+
+    ospf_lsdb_destroy(db);
+    printf(TEST_PASSED, "test_ospf_lsdb_install_lookup");
+}
+
+void test_ospf_lsdb_age() {
+    ospf_lsdb_t *db = ospf_lsdb_create(SELF_ID, 0);
+    const ospf_lsdb_entry_t *entry;
+
+    assert(db != NULL);
+    install(db, 1, PEER_ID, PEER_ID, 0x80000001, 100, 0);
+
+    // The age keeps counting from what the LSA carried, up to MaxAge
+    entry = ospf_lsdb_lookup(db, 1, PEER_ID, PEER_ID);
+    assert(ospf_lsdb_entry_age(entry, 0) == 100);
+    assert(ospf_lsdb_entry_age(entry, 50) == 150);
+    assert(ospf_lsdb_entry_age(entry, 10 * OSPF_LSDB_MAX_AGE) == OSPF_LSDB_MAX_AGE);
+
+    ospf_lsdb_destroy(db);
+    printf(TEST_PASSED, "test_ospf_lsdb_age");
+}
+
+void test_ospf_lsdb_deadlines() {
+    ospf_lsdb_t *db = ospf_lsdb_create(SELF_ID, 0);
+    aging_ctx_t ctx = {0};
+
+    assert(db != NULL);
+    install(db, 1, SELF_ID, SELF_ID, 0x80000001, 0, 0);
+    install(db, 1, PEER_ID, PEER_ID, 0x80000001, 0, 0);
+    install(db, 2, 0x0A000001, PEER_ID, 0x80000001, OSPF_LSDB_MAX_AGE - 600, 0);
+
+    // Nothing is due before the first deadline
+    assert(ospf_lsdb_age(db, 599, on_deadline, &ctx) == 0);
+
+    // An LSA installed old reaches MaxAge early and stays until flushed
+    assert(ospf_lsdb_age(db, 600, on_deadline, &ctx) == 1);
+    assert(ctx.max_ages == 1 && ctx.last_adv_router == PEER_ID);
+    assert(ospf_lsdb_lookup(db, 2, 0x0A000001, PEER_ID) != NULL);
+
+    // Our own LSAs come up for refresh; reoriginating them restarts the clock
+    ctx.reinstall = true;
+    ctx.now = OSPF_LSDB_REFRESH_TIME;
+    assert(ospf_lsdb_age(db, OSPF_LSDB_REFRESH_TIME, on_deadline, &ctx) == 1);
+    assert(ctx.refreshes == 1 && ctx.last_adv_router == SELF_ID);
+    assert(ospf_lsdb_lookup(db, 1, SELF_ID, SELF_ID)->seq == 0x80000002);
+
+    // Others' LSAs only age out, while ours are refreshed again
+    ctx.flush = true;
+    ctx.now = OSPF_LSDB_MAX_AGE;
+    assert(ospf_lsdb_age(db, OSPF_LSDB_MAX_AGE, on_deadline, &ctx) == 2);
+    assert(ctx.max_ages == 2 && ctx.refreshes == 2);
+    assert(ospf_lsdb_lookup(db, 1, PEER_ID, PEER_ID) == NULL);
+    assert(ospf_lsdb_lookup(db, 1, SELF_ID, SELF_ID) != NULL);
+
+    // A long gap reports each deadline once
+    ctx.now = 3 * OSPF_LSDB_MAX_AGE;
+    assert(ospf_lsdb_age(db, 3 * OSPF_LSDB_MAX_AGE, on_deadline, &ctx) >= 1);
+    assert(ospf_lsdb_age(db, 3 * OSPF_LSDB_MAX_AGE, on_deadline, &ctx) == 0);
+
+    ospf_lsdb_destroy(db);
+    printf(TEST_PASSED, "test_ospf_lsdb_deadlines");
+}
+
+void test_ospf_lsdb_many() {
+    ospf_lsdb_t *db = ospf_lsdb_create(SELF_ID, 0);
+    uint32_t visited = 0, i;
+
+    assert(db != NULL);
+    for (i = 0; i < MANY_LSAS; i++) {
+        install(db, 5, 0x0A000000 + i, PEER_ID + (i % 7), 0x80000001, 0, 0);
+    }
+    assert(ospf_lsdb_count(db) == MANY_LSAS);
+    for (i = 0; i < MANY_LSAS; i++) {
+        assert(ospf_lsdb_lookup(db, 5, 0x0A000000 + i, PEER_ID + (i % 7)) != NULL);
+    }
+
+    ospf_lsdb_foreach(db, count_lsa, &visited);
+    assert(visited == MANY_LSAS);
+    visited = 0;
+    ospf_lsdb_foreach(db, stop_at_first, &visited);
+    assert(visited == 1);
+
+    // Every one of them ages out at once
+    assert(ospf_lsdb_age(db, OSPF_LSDB_MAX_AGE, NULL, NULL) == MANY_LSAS);
+
+    ospf_lsdb_destroy(db);
+    printf(TEST_PASSED, "test_ospf_lsdb_many");
+}
+
+int main() {
+    printf("Running OSPF LSDB unit tests...\n");
+
+    test_ospf_lsdb_install_lookup();
+    test_ospf_lsdb_age();
+    test_ospf_lsdb_deadlines();
+    test_ospf_lsdb_many();
+
+    printf("All OSPF LSDB tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,261 @@
+/**
+ * @file test_ospf_spf.c
+ * @brief Unit tests for the OSPF shortest path first engine
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/l3/ospf_spf.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define MAX_CHANGES 32
+
+#define R(n) ((uint32_t)(n))
+#define ROUTER OSPF_SPF_VERTEX_ROUTER
+#define NETWORK OSPF_SPF_VERTEX_NETWORK
+
+typedef struct {
+    uint32_t count;
+    ospf_spf_route_t routes[MAX_CHANGES];
+} changes_t;
+
+static void record_change(const ospf_spf_route_t *route, void *ctx) {
+    changes_t *changes = ctx;
+
+    assert(changes->count < MAX_CHANGES);
+    changes->routes[changes->count++] = *route;
+}
+
+static const ospf_spf_route_t *find_change(const changes_t *changes, uint32_t addr, uint8_t prefix_len) {
+    for (uint32_t i = 0; i < changes->count; i++) {
+        if (changes->routes[i].addr == addr && changes->routes[i].prefix_len == prefix_len) {
+            return &changes->routes[i];
+        }
+    }
+    return NULL;
+}
+
+static void set_links(ospf_spf_t *spf, uint32_t id, const ospf_spf_link_t *links, uint32_t count) {
+    assert(ospf_spf_set_links(spf, ROUTER, id, links, count) == STATUS_SUCCESS);
+}
+
+static void set_stub(ospf_spf_t *spf, uint32_t id, uint32_t addr, uint8_t prefix_len, uint32_t metric) {
+    ospf_spf_prefix_t prefix = { .addr = addr, .prefix_len = prefix_len, .metric = metric };
+
+    assert(ospf_spf_set_prefixes(spf, ROUTER, id, &prefix, 1) == STATUS_SUCCESS);
+}
+
+static ospf_spf_route_t get_route(ospf_spf_t *spf, uint32_t addr, uint8_t prefix_len) {
+    ospf_spf_route_t route;
+
+    assert(ospf_spf_get_route(spf, addr, prefix_len, &route) == STATUS_SUCCESS);
+    return route;
+}
+
+static bool has_nexthop(const ospf_spf_route_t *route, uint32_t id) {
+    for (uint32_t i = 0; i < route->nexthop_count; i++) {
+        if (route->nexthops[i] == id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Square of four routers, R1 the root:
+ *
+ *   R1 --10-- R2
+ *   |          |
+ *   10         5
+ *   |          |
+ *   R3 --5--- R4
+ */
+static ospf_spf_t *make_square(void) {
+    ospf_spf_t *spf = ospf_spf_create(R(1));
+    ospf_spf_link_t r1[] = { { ROUTER, R(2), 10 }, { ROUTER, R(3), 10 } };
+    ospf_spf_link_t r2[] = { { ROUTER, R(1), 10 }, { ROUTER, R(4), 5 } };
+    ospf_spf_link_t r3[] = { { ROUTER, R(1), 10 }, { ROUTER, R(4), 5 } };
+    ospf_spf_link_t r4[] = { { ROUTER, R(2), 5 }, { ROUTER, R(3), 5 } };
+
+    assert(spf != NULL);
+    set_links(spf, R(1), r1, 2);
+    set_links(spf, R(2), r2, 2);
+    set_links(spf, R(3), r3, 2);
+    set_links(spf, R(4), r4, 2);
+    set_stub(spf, R(1), 0x0A010000, 24, 1);
+    set_stub(spf, R(2), 0x0A020000, 16, 1);
+    set_stub(spf, R(4), 0x0A040000, 16, 1);
+    return spf;
+}
+
+void test_ospf_spf_ecmp() {
+    ospf_spf_t *spf = make_square();
+    changes_t changes = {0};
+    ospf_spf_route_t route;
+    ospf_spf_stats_t stats;
+
+    assert(ospf_spf_run(spf, record_change, &changes) == STATUS_SUCCESS);
+    assert(changes.count == 3);
+
+    assert(ospf_spf_get_distance(spf, ROUTER, R(1)) == 0);
+    assert(ospf_spf_get_distance(spf, ROUTER, R(4)) == 15);
+    assert(ospf_spf_get_distance(spf, ROUTER, R(9)) == OSPF_SPF_INFINITY);
+
+    // Both halves of the square reach R4 at the same cost
+    route = get_route(spf, 0x0A040000, 16);
+    assert(route.cost == 16);
+    assert(route.nexthop_count == 2 && has_nexthop(&route, R(2)) && has_nexthop(&route, R(3)));
+
+    // The root's own stub is directly attached
+    route = get_route(spf, 0x0A010000, 24);
+    assert(route.cost == 1 && route.nexthop_count == 1 && route.nexthops[0] == 0);
+
+    // R3 reaches R2 through R4 without coming back through R1
+    route = get_route(spf, 0x0A020000, 16);
+    assert(route.cost == 11 && route.nexthop_count == 1 && route.nexthops[0] == R(2));
+    assert(route.backup == R(3));
+
+    assert(ospf_spf_get_stats(spf, &stats) == STATUS_SUCCESS);
+    assert(stats.full_runs == 1 && stats.vertices == 4 && stats.prefixes == 3);
+    assert(stats.protected_prefixes >= 1);
+
+    ospf_spf_destroy(spf);
+    printf(TEST_PASSED, "test_ospf_spf_ecmp");
+}
+
+void test_ospf_spf_two_way_check() {
+    ospf_spf_t *spf = make_square();
+    ospf_spf_link_t r2[] = { { ROUTER, R(1), 10 }, { ROUTER, R(4), 5 }, { ROUTER, R(5), 1 } };
+    ospf_spf_link_t r5[] = { { ROUTER, R(2), 1 } };
+    ospf_spf_route_t route;
+
+    // R2 claims a link to R5, which does not link back yet
+    set_links(spf, R(2), r2, 3);
+    assert(ospf_spf_set_links(spf, ROUTER, R(5), NULL, 0) == STATUS_SUCCESS);
+    set_stub(spf, R(5), 0x0A050000, 16, 1);
+    assert(ospf_spf_run(spf, NULL, NULL) == STATUS_SUCCESS);
+    assert(ospf_spf_get_distance(spf, ROUTER, R(5)) == OSPF_SPF_INFINITY);
+    assert(ospf_spf_get_route(spf, 0x0A050000, 16, &route) == STATUS_NOT_FOUND);
+
+    // Once it does the link is used
+    set_links(spf, R(5), r5, 1);
+    assert(ospf_spf_run(spf, NULL, NULL) == STATUS_SUCCESS);
+    assert(ospf_spf_get_distance(spf, ROUTER, R(5)) == 11);
+    route = get_route(spf, 0x0A050000, 16);
+    assert(route.cost == 12 && route.nexthops[0] == R(2));
+
+    ospf_spf_destroy(spf);
+    printf(TEST_PASSED, "test_ospf_spf_two_way_check");
+}
+
+void test_ospf_spf_partial_run() {
+    ospf_spf_t *spf = make_square();
+    changes_t changes = {0};
+    const ospf_spf_route_t *change;
+    ospf_spf_stats_t stats;
+
+    assert(ospf_spf_run(spf, NULL, NULL) == STATUS_SUCCESS);
+
+    // A stub metric change only recomputes the prefixes it touches
+    set_stub(spf, R(4), 0x0A040000, 16, 3);
+    assert(ospf_spf_run(spf, record_change, &changes) == STATUS_SUCCESS);
+    assert(changes.count == 1);
+    change = find_change(&changes, 0x0A040000, 16);
+    assert(change != NULL && change->cost == 18);
+
+    assert(ospf_spf_get_stats(spf, &stats) == STATUS_SUCCESS);
+    assert(stats.full_runs == 1 && stats.partial_runs == 1);
+
+    // A run with nothing to do reports nothing
+    changes.count = 0;
+    assert(ospf_spf_run(spf, record_change, &changes) == STATUS_SUCCESS);
+    assert(changes.count == 0);
+
+    ospf_spf_destroy(spf);
+    printf(TEST_PASSED, "test_ospf_spf_partial_run");
+}
+
+void test_ospf_spf_link_failure() {
+    ospf_spf_t *spf = make_square();
+    ospf_spf_link_t r1[] = { { ROUTER, R(3), 10 } };
+    ospf_spf_link_t r2[] = { { ROUTER, R(4), 5 } };
+    changes_t changes = {0};
+    const ospf_spf_route_t *change;
+    ospf_spf_route_t route;
+
+    assert(ospf_spf_run(spf, NULL, NULL) == STATUS_SUCCESS);
+
+    // R1-R2 fails: R2 is now reached round the square through R3
+    set_links(spf, R(1), r1, 1);
+    set_links(spf, R(2), r2, 1);
+    assert(ospf_spf_run(spf, record_change, &changes) == STATUS_SUCCESS);
+    change = find_change(&changes, 0x0A020000, 16);
+    assert(change != NULL && change->cost == 21);
+    assert(change->nexthop_count == 1 && change->nexthops[0] == R(3));
+
+    route = get_route(spf, 0x0A040000, 16);
+    assert(route.cost == 16 && route.nexthop_count == 1 && route.nexthops[0] == R(3));
+
+    // Flushing R4 cuts R2 off too; both routes are withdrawn
+    changes.count = 0;
+    assert(ospf_spf_remove_vertex(spf, ROUTER, R(4)) == STATUS_SUCCESS);
+    assert(ospf_spf_remove_vertex(spf, ROUTER, R(9)) == STATUS_NOT_FOUND);
+    assert(ospf_spf_run(spf, record_change, &changes) == STATUS_SUCCESS);
+    change = find_change(&changes, 0x0A040000, 16);
+    assert(change != NULL && change->cost == OSPF_SPF_INFINITY);
+    change = find_change(&changes, 0x0A020000, 16);
+    assert(change != NULL && change->cost == OSPF_SPF_INFINITY);
+    assert(ospf_spf_get_route(spf, 0x0A020000, 16, &route) == STATUS_NOT_FOUND);
+
+    ospf_spf_destroy(spf);
+    printf(TEST_PASSED, "test_ospf_spf_link_failure");
+}
+
+void test_ospf_spf_transit_network() {
+    ospf_spf_t *spf = ospf_spf_create(R(1));
+    ospf_spf_link_t r1[] = { { NETWORK, 0xC0A80001, 4 } };
+    ospf_spf_link_t r6[] = { { NETWORK, 0xC0A80001, 7 } };
+    ospf_spf_link_t lan[] = { { ROUTER, R(1), 0 }, { ROUTER, R(6), 0 } };
+    ospf_spf_route_t route;
+
+    assert(spf != NULL);
+    assert(ospf_spf_set_links(spf, ROUTER, R(1), r1, 1) == STATUS_SUCCESS);
+    assert(ospf_spf_set_links(spf, ROUTER, R(6), r6, 1) == STATUS_SUCCESS);
+    assert(ospf_spf_set_links(spf, NETWORK, 0xC0A80001, lan, 2) == STATUS_SUCCESS);
+    set_stub(spf, R(6), 0x0A060000, 16, 2);
+
+    // Routers on a LAN are one cost away: the network adds nothing
+    assert(ospf_spf_run(spf, NULL, NULL) == STATUS_SUCCESS);
+    assert(ospf_spf_get_distance(spf, NETWORK, 0xC0A80001) == 4);
+    assert(ospf_spf_get_distance(spf, ROUTER, R(6)) == 4);
+    route = get_route(spf, 0x0A060000, 16);
+    assert(route.cost == 6 && route.nexthop_count == 1 && route.nexthops[0] == R(6));
+
+    // Bad prefixes are refused
+    assert(ospf_spf_set_links(NULL, ROUTER, R(1), r1, 1) == STATUS_INVALID_PARAMETER);
+    {
+        ospf_spf_prefix_t bad = { .addr = 0x0A000000, .prefix_len = 33, .metric = 1 };
+        assert(ospf_spf_set_prefixes(spf, ROUTER, R(6), &bad, 1) == STATUS_INVALID_PARAMETER);
+    }
+
+    ospf_spf_destroy(spf);
+    printf(TEST_PASSED, "test_ospf_spf_transit_network");
+}
+
+int main() {
+    printf("Running OSPF SPF unit tests...\n");
+
+    test_ospf_spf_ecmp();
+    test_ospf_spf_two_way_check();
+    test_ospf_spf_partial_run();
+    test_ospf_spf_link_failure();
+    test_ospf_spf_transit_network();
+
+    printf("All OSPF SPF tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,211 @@
+/**
+ * @file test_ospf_throttle.c
+ * @brief Unit tests for OSPF SPF back-off and LSA throttling
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/l3/ospf_throttle.h"
+#include "../../include/common/event_loop.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define MS 1000ULL
+#define MAX_RUNS 8
+#define SLACK_MS 1                  /* Timers expire on a wheel tick, times are truncated */
+
+/* Shortened timing so a whole incident fits in well under a second */
+static ospf_throttle_config_t g_config = {
+    .spf_initial_delay_ms = 10,
+    .spf_short_delay_ms = 40,
+    .spf_long_delay_ms = 200,
+    .spf_time_to_learn_ms = 100,
+    .spf_holddown_ms = 400,
+    .lsa_start_ms = 0,
+    .lsa_hold_ms = 40,
+    .lsa_max_wait_ms = 100,
+};
+
+typedef struct {
+    uint64_t start_us;
+    uint32_t count;
+    uint64_t at_ms[MAX_RUNS];       /* When each run happened, from start_us */
+} runs_t;
+
+static void record_run(void *arg) {
+    runs_t *runs = arg;
+
+    assert(runs->count < MAX_RUNS);
+    runs->at_ms[runs->count++] = (event_loop_now_us() - runs->start_us) / MS;
+}
+
+static void stop_loop(event_timer_t *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+    event_loop_stop();
+}
+
+/* SPF scenario: IGP events at fixed offsets, state sampled before each */
+typedef struct {
+    ospf_spf_backoff_t *backoff;
+    ospf_spf_backoff_state_t state_before;
+} spf_event_t;
+
+static void spf_event(event_timer_t *timer, void *arg) {
+    spf_event_t *event = arg;
+    (void)timer;
+
+    event->state_before = ospf_spf_backoff_get_state(event->backoff);
+    ospf_spf_backoff_event(event->backoff);
+}
+
+void test_ospf_throttle_config() {
+    ospf_throttle_config_t config;
+
+    ospf_throttle_get_default_config(&config);
+    assert(config.spf_initial_delay_ms == OSPF_THROTTLE_SPF_INITIAL_DELAY_MS);
+    assert(config.lsa_hold_ms == OSPF_THROTTLE_LSA_HOLD_MS);
+    assert(ospf_throttle_validate_config(&config) == STATUS_SUCCESS);
+    assert(ospf_throttle_validate_config(&g_config) == STATUS_SUCCESS);
+
+    config.spf_short_delay_ms = config.spf_long_delay_ms + 1;
+    assert(ospf_throttle_validate_config(&config) == STATUS_INVALID_PARAMETER);
+    ospf_throttle_get_default_config(&config);
+    config.spf_time_to_learn_ms = config.spf_holddown_ms;
+    assert(ospf_throttle_validate_config(&config) == STATUS_INVALID_PARAMETER);
+    ospf_throttle_get_default_config(&config);
+    config.lsa_hold_ms = config.lsa_max_wait_ms + 1;
+    assert(ospf_throttle_validate_config(&config) == STATUS_INVALID_PARAMETER);
+    assert(ospf_throttle_validate_config(NULL) == STATUS_INVALID_PARAMETER);
+
+    printf(TEST_PASSED, "test_ospf_throttle_config");
+}
+
+void test_ospf_spf_backoff() {
+    ospf_spf_backoff_t backoff;
+    runs_t runs = {0};
+    spf_event_t events[4];
+    event_timer_t event_timers[4];
+    event_timer_t stop;
+    /* Two events within TIME_TO_LEARN, one after it, one while a run is pending */
+    const uint64_t offsets_ms[4] = { 0, 20, 150, 160 };
+
+    ospf_spf_backoff_init(&backoff, &g_config, record_run, &runs);
+    assert(ospf_spf_backoff_get_state(&backoff) == OSPF_SPF_BACKOFF_QUIET);
+
+    runs.start_us = event_loop_now_us();
+    for (int i = 0; i < 4; i++) {
+        events[i].backoff = &backoff;
+        event_timer_init(&event_timers[i], spf_event, &events[i]);
+        if (offsets_ms[i] == 0) {
+            spf_event(&event_timers[i], &events[i]);
+        } else {
+            assert(event_timer_start(&event_timers[i], offsets_ms[i] * MS, 0) == STATUS_SUCCESS);
+        }
+    }
+    // HOLDDOWN after the last event brings the machine back to QUIET
+    event_timer_init(&stop, stop_loop, NULL);
+    assert(event_timer_start(&stop, (160 + g_config.spf_holddown_ms + 50) * MS, 0) == STATUS_SUCCESS);
+    assert(event_loop_run() == STATUS_SUCCESS);
+
+    // Quiet, then learning with the short delay, then flapping with the long one
+    assert(events[0].state_before == OSPF_SPF_BACKOFF_QUIET);
+    assert(events[1].state_before == OSPF_SPF_BACKOFF_SHORT_WAIT);
+    assert(events[2].state_before == OSPF_SPF_BACKOFF_LONG_WAIT);
+    assert(events[3].state_before == OSPF_SPF_BACKOFF_LONG_WAIT);
+
+    // The event at 160 ms was absorbed by the run already scheduled
+    assert(runs.count == 3);
+    assert(runs.at_ms[0] + SLACK_MS >= 10 && runs.at_ms[0] < 20);
+    assert(runs.at_ms[1] + SLACK_MS >= 20 + 40 && runs.at_ms[1] < 150);
+    assert(runs.at_ms[2] + SLACK_MS >= 150 + 200);
+    assert(backoff.events == 4 && backoff.runs == 3);
+    assert(ospf_spf_backoff_get_state(&backoff) == OSPF_SPF_BACKOFF_QUIET);
+
+    // A reset drops a pending run
+    ospf_spf_backoff_event(&backoff);
+    assert(ospf_spf_backoff_get_state(&backoff) == OSPF_SPF_BACKOFF_SHORT_WAIT);
+    ospf_spf_backoff_reset(&backoff);
+    assert(ospf_spf_backoff_get_state(&backoff) == OSPF_SPF_BACKOFF_QUIET);
+    assert(event_timer_start(&stop, 50 * MS, 0) == STATUS_SUCCESS);
+    assert(event_loop_run() == STATUS_SUCCESS);
+    assert(runs.count == 3);
+
+    printf(TEST_PASSED, "test_ospf_spf_backoff");
+}
+
+/* LSA scenario: requests at fixed offsets, their results kept */
+typedef struct {
+    ospf_lsa_throttle_t *throttle;
+    bool scheduled;
+} lsa_request_t;
+
+static void lsa_request(event_timer_t *timer, void *arg) {
+    lsa_request_t *request = arg;
+    (void)timer;
+
+    request->scheduled = ospf_lsa_throttle_request(request->throttle);
+}
+
+void test_ospf_lsa_throttle() {
+    ospf_lsa_throttle_t throttle;
+    runs_t runs = {0};
+    lsa_request_t requests[5];
+    event_timer_t request_timers[5];
+    event_timer_t stop;
+    /* Back to back requests: each waits for the doubled interval */
+    const uint64_t offsets_ms[5] = { 0, 5, 10, 50, 130 };
+
+    ospf_lsa_throttle_init(&throttle, &g_config, record_run, &runs);
+
+    runs.start_us = event_loop_now_us();
+    for (int i = 0; i < 5; i++) {
+        requests[i].throttle = &throttle;
+        event_timer_init(&request_timers[i], lsa_request, &requests[i]);
+        assert(event_timer_start(&request_timers[i], offsets_ms[i] * MS, 0) == STATUS_SUCCESS);
+    }
+    event_timer_init(&stop, stop_loop, NULL);
+    assert(event_timer_start(&stop, 400 * MS, 0) == STATUS_SUCCESS);
+    assert(event_loop_run() == STATUS_SUCCESS);
+
+    // The request at 10 ms joined the one pending since 5 ms
+    assert(requests[0].scheduled && requests[1].scheduled);
+    assert(!requests[2].scheduled);
+    assert(requests[3].scheduled && requests[4].scheduled);
+
+    // Start delay, then the hold time, then twice it, then the maximum
+    assert(runs.count == 4);
+    assert(runs.at_ms[0] < 5);
+    assert(runs.at_ms[1] + SLACK_MS >= runs.at_ms[0] + 40);
+    assert(runs.at_ms[2] + SLACK_MS >= runs.at_ms[1] + 80);
+    assert(runs.at_ms[3] + SLACK_MS >= runs.at_ms[2] + 100);
+
+    // A pending origination can be dropped
+    assert(ospf_lsa_throttle_request(&throttle));
+    assert(ospf_lsa_throttle_cancel(&throttle));
+    assert(!ospf_lsa_throttle_cancel(&throttle));
+    assert(event_timer_start(&stop, 150 * MS, 0) == STATUS_SUCCESS);
+    assert(event_loop_run() == STATUS_SUCCESS);
+    assert(runs.count == 4);
+
+    printf(TEST_PASSED, "test_ospf_lsa_throttle");
+}
+
+int main() {
+    printf("Running OSPF throttle unit tests...\n");
+
+    assert(event_loop_init() == STATUS_SUCCESS);
+
+    test_ospf_throttle_config();
+    test_ospf_spf_backoff();
+    test_ospf_lsa_throttle();
+
+    assert(event_loop_shutdown() == STATUS_SUCCESS);
+
+    printf("All OSPF throttle tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,745 @@
+/**
+ * @file test_packet.c
+ * @brief Unit tests for packet buffer management
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "../../include/hal/packet.h"
+#include "../../include/common/config.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+/* Enough short-lived threads to strand the whole pool in their caches if exits leaked them */
+#define FLUSH_THREADS (CONFIG_PACKET_BUFFER_POOL_SIZE / 16 + 8)
+
+void test_packet_pool_alloc_free() {
+    packet_pool_stats_t stats;
+
+    packet_reset_pool_stats();
+    packet_buffer_t *pkt = packet_buffer_alloc(1500);
+    assert(pkt != NULL);
+    assert(pkt->capacity == 1500);
+    assert(pkt->size == 0);
+    assert(pkt->flags & PACKET_FLAG_POOLED);
+
+    assert(packet_get_pool_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.pool_size == CONFIG_PACKET_BUFFER_POOL_SIZE);
+    assert(stats.in_use == 1);
+    assert(stats.alloc_count == 1);
+
+    packet_buffer_free(pkt);
+    packet_get_pool_stats(&stats);
+    assert(stats.in_use == 0);
+    assert(stats.free_count == 1);
+
+    // Freed slot is reused from the thread cache
+    packet_buffer_t *again = packet_buffer_alloc(64);
+    assert(again == pkt);
+    packet_buffer_free(again);
+
+    printf(TEST_PASSED, "test_packet_pool_alloc_free");
+}
+
+void test_packet_pool_oversize() {
+    packet_pool_stats_t stats;
+
+    packet_reset_pool_stats();
+    packet_buffer_t *pkt = packet_buffer_alloc(CONFIG_MAX_PACKET_SIZE + 1);
+    assert(pkt != NULL);
+    assert(!(pkt->flags & PACKET_FLAG_POOLED));
+
+    packet_get_pool_stats(&stats);
+    assert(stats.oversize_count == 1);
+    assert(stats.heap_fallback_count == 1);
+
+    packet_buffer_free(pkt);
+    printf(TEST_PASSED, "test_packet_pool_oversize");
+}
+
+void test_packet_pool_exhaustion() {
+    packet_pool_stats_t stats;
+    packet_buffer_t **pkts = calloc(CONFIG_PACKET_BUFFER_POOL_SIZE + 1, sizeof(*pkts));
+    assert(pkts != NULL);
+
+    packet_reset_pool_stats();
+    for (uint32_t i = 0; i <= CONFIG_PACKET_BUFFER_POOL_SIZE; i++) {
+        pkts[i] = packet_buffer_alloc(128);
+        assert(pkts[i] != NULL);
+    }
+
+    packet_get_pool_stats(&stats);
+    assert(stats.in_use == CONFIG_PACKET_BUFFER_POOL_SIZE);
+    assert(stats.exhausted_count == 1);
+    assert(!(pkts[CONFIG_PACKET_BUFFER_POOL_SIZE]->flags & PACKET_FLAG_POOLED));
+
+    for (uint32_t i = 0; i <= CONFIG_PACKET_BUFFER_POOL_SIZE; i++) {
+        packet_buffer_free(pkts[i]);
+    }
+    packet_get_pool_stats(&stats);
+    assert(stats.in_use == 0);
+
+    free(pkts);
+    printf(TEST_PASSED, "test_packet_pool_exhaustion");
+}
+
+/* Take one buffer and give it back, leaving slots in this thread's cache */
+static void *alloc_free_thread(void *arg) {
+    packet_buffer_t *pkt = packet_buffer_alloc(128);
+
+    (void)arg;
+    assert(pkt != NULL && (pkt->flags & PACKET_FLAG_POOLED));
+    packet_buffer_free(pkt);
+    return NULL;
+}
+
+void test_packet_pool_thread_flush() {
+    packet_pool_stats_t stats;
+    packet_buffer_t **pkts = calloc(CONFIG_PACKET_BUFFER_POOL_SIZE, sizeof(*pkts));
+    pthread_t thread;
+
+    assert(pkts != NULL);
+    packet_reset_pool_stats();
+
+    // Exiting threads hand their cached slots back
+    for (uint32_t i = 0; i < FLUSH_THREADS; i++) {
+        assert(pthread_create(&thread, NULL, alloc_free_thread, NULL) == 0);
+        assert(pthread_join(thread, NULL) == 0);
+    }
+    packet_get_pool_stats(&stats);
+    assert(stats.exhausted_count == 0 && stats.heap_fallback_count == 0 && stats.in_use == 0);
+
+    // So the whole pool is there for this thread
+    for (uint32_t i = 0; i < CONFIG_PACKET_BUFFER_POOL_SIZE; i++) {
+        pkts[i] = packet_buffer_alloc(128);
+        assert(pkts[i] != NULL && (pkts[i]->flags & PACKET_FLAG_POOLED));
+    }
+    for (uint32_t i = 0; i < CONFIG_PACKET_BUFFER_POOL_SIZE; i++) {
+        packet_buffer_free(pkts[i]);
+    }
+
+    // A flush empties the cache, so the next allocation misses it
+    packet_pool_thread_flush();
+    packet_reset_pool_stats();
+    pkts[0] = packet_buffer_alloc(128);
+    assert(pkts[0] != NULL);
+    packet_get_pool_stats(&stats);
+    assert(stats.cache_hits == 0);
+    packet_buffer_free(pkts[0]);
+
+    free(pkts);
+    printf(TEST_PASSED, "test_packet_pool_thread_flush");
+}
+
+void test_packet_pool_resize() {
+    const uint8_t payload[4] = {0xde, 0xad, 0xbe, 0xef};
+    packet_buffer_t *pkt = packet_buffer_alloc(64);
+    assert(pkt != NULL);
+    assert(packet_append_data(pkt, payload, sizeof(payload)) == STATUS_SUCCESS);
+
+    // Growing beyond capacity moves the data out of the pool slot
+    assert(packet_buffer_resize(pkt, CONFIG_MAX_PACKET_SIZE * 2) == STATUS_SUCCESS);
+    assert(pkt->flags & PACKET_FLAG_EXT_DATA);
+    assert(memcmp(pkt->data, payload, sizeof(payload)) == 0);
+
+    packet_buffer_free(pkt);
+    printf(TEST_PASSED, "test_packet_pool_resize");
+}
+
+void test_packet_push_pull_header() {
+    const uint8_t payload[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    uint8_t *hdr = NULL;
+    packet_buffer_t *pkt = packet_buffer_alloc(64);
+    assert(pkt != NULL);
+    assert(packet_headroom(pkt) == CONFIG_PACKET_HEADROOM);
+    packet_append_data(pkt, payload, sizeof(payload));
+
+    uint8_t *old_data = pkt->data;
+    assert(packet_push_header(pkt, 4, &hdr) == STATUS_SUCCESS);
+    assert(hdr == old_data - 4);
+    assert(pkt->size == sizeof(payload) + 4);
+    assert(packet_headroom(pkt) == CONFIG_PACKET_HEADROOM - 4);
+    assert(memcmp(pkt->data + 4, payload, sizeof(payload)) == 0);
+
+    assert(packet_pull_header(pkt, 4, NULL) == STATUS_SUCCESS);
+    assert(pkt->data == old_data);
+    assert(pkt->size == sizeof(payload));
+    assert(packet_pull_header(pkt, 64, NULL) == STATUS_OUT_OF_BOUNDS);
+
+    // Exhaust headroom; push falls back to shifting the payload
+    assert(packet_push_header(pkt, CONFIG_PACKET_HEADROOM, NULL) == STATUS_SUCCESS);
+    assert(packet_headroom(pkt) == 0);
+    assert(packet_push_header(pkt, 2, NULL) == STATUS_SUCCESS);
+    assert(memcmp(pkt->data + 2 + CONFIG_PACKET_HEADROOM, payload, sizeof(payload)) == 0);
+
+    packet_buffer_free(pkt);
+    printf(TEST_PASSED, "test_packet_push_pull_header");
+}
+
+void test_packet_vlan_push_pop() {
+    uint8_t frame[60] = {0};
+    vlan_id_t vid = 0;
+    uint16_t tci = 0;
+
+    memset(frame, 0xAA, 6);          // dst
+    memset(frame + 6, 0xBB, 6);      // src
+    frame[12] = 0x08; frame[13] = 0x00;
+    frame[14] = 0x45;
+
+    packet_buffer_t *pkt = packet_buffer_alloc(128);
+    packet_append_data(pkt, frame, sizeof(frame));
+    assert(!packet_has_vlan_tag(pkt, &vid));
+
+    assert(packet_vlan_push(pkt, ETHERTYPE_VLAN, 100) == STATUS_SUCCESS);
+    assert(pkt->size == sizeof(frame) + 4);
+    assert(packet_has_vlan_tag(pkt, &vid) && vid == 100);
+    assert(pkt->data[0] == 0xAA && pkt->data[11] == 0xBB);
+    assert(pkt->data[16] == 0x08 && pkt->data[18] == 0x45);
+
+    assert(packet_vlan_pop(pkt, &tci) == STATUS_SUCCESS);
+    assert(tci == 100);
+    assert(pkt->size == sizeof(frame));
+    assert(memcmp(pkt->data, frame, sizeof(frame)) == 0);
+    assert(packet_vlan_pop(pkt, NULL) == STATUS_NOT_FOUND);
+
+    // Double tag push goes through headroom in one step
+    uint32_t headroom = packet_headroom(pkt);
+    uint16_t s_tci = 0, c_tci = 0;
+    assert(packet_qinq_pop(pkt, NULL, NULL) == STATUS_NOT_FOUND);
+    assert(packet_qinq_push(pkt, 200, 100) == STATUS_SUCCESS);
+    assert(pkt->size == sizeof(frame) + 8 && packet_headroom(pkt) == headroom - 8);
+    assert(pkt->data[12] == 0x88 && pkt->data[13] == 0xA8 && pkt->data[16] == 0x81);
+    assert(packet_has_vlan_tag(pkt, &vid) && vid == 200);
+    assert(packet_qinq_pop(pkt, &s_tci, &c_tci) == STATUS_SUCCESS);
+    assert(s_tci == 200 && c_tci == 100);
+    assert(memcmp(pkt->data, frame, sizeof(frame)) == 0);
+    assert(!pkt->metadata.is_tagged);
+
+    packet_buffer_free(pkt);
+    printf(TEST_PASSED, "test_packet_vlan_push_pop");
+}
+
+void test_packet_clone_shared() {
+    const uint8_t payload[16] = {0x10, 0x20, 0x30, 0x40};
+    const uint8_t patch = 0x99;
+    packet_pool_stats_t stats;
+
+    packet_buffer_t *orig = packet_buffer_alloc(256);
+    packet_append_data(orig, payload, sizeof(payload));
+
+    packet_buffer_t *c1 = packet_buffer_clone_shared(orig);
+    packet_buffer_t *c2 = packet_buffer_clone_shared(orig);
+    assert(c1 && c2);
+    assert(packet_is_shared(orig) && packet_is_shared(c1));
+    assert(c1->data == orig->data && c2->data == orig->data);
+
+    // Writing a clone copies its data; others are unaffected
+    assert(packet_update_data(c1, 0, &patch, 1) == STATUS_SUCCESS);
+    assert(!packet_is_shared(c1));
+    assert(c1->data != orig->data);
+    assert(c1->data[0] == patch && orig->data[0] == payload[0]);
+
+    // Owner may be freed first; remaining clone keeps the data alive
+    packet_buffer_free(orig);
+    assert(memcmp(c2->data, payload, sizeof(payload)) == 0);
+
+    // Data lives in the owner's slot, so the last holder copies it into its
+    // own slot and the owner's slot is released
+    uint8_t *shared_data = c2->data;
+    assert(packet_make_writable(c2) == STATUS_SUCCESS);
+    assert(!packet_is_shared(c2));
+    assert(c2->data != shared_data);
+
+    packet_buffer_free(c1);
+    packet_buffer_free(c2);
+    packet_get_pool_stats(&stats);
+    assert(stats.in_use == 0);
+
+    printf(TEST_PASSED, "test_packet_clone_shared");
+}
+
+void test_packet_clone_shared_owner_write() {
+    const uint8_t payload[4] = {1, 2, 3, 4};
+    const uint8_t patch = 0xEE;
+    packet_pool_stats_t stats;
+
+    packet_buffer_t *orig = packet_buffer_alloc(64);
+    packet_append_data(orig, payload, sizeof(payload));
+    packet_buffer_t *clone = packet_buffer_clone_shared(orig);
+
+    // Owner write while shared goes to a private heap copy
+    assert(packet_update_data(orig, 3, &patch, 1) == STATUS_SUCCESS);
+    assert(orig->flags & PACKET_FLAG_EXT_DATA);
+    assert(clone->data[3] == 4 && orig->data[3] == patch);
+
+    packet_buffer_free(clone);
+    packet_buffer_free(orig);
+    packet_get_pool_stats(&stats);
+    assert(stats.in_use == 0);
+
+    printf(TEST_PASSED, "test_packet_clone_shared_owner_write");
+}
+
+static packet_result_t drop_odd_size(packet_buffer_t *packet, void *user_data) {
+    (void)user_data;
+    return (packet->size & 1) ? PACKET_RESULT_DROP : PACKET_RESULT_FORWARD;
+}
+
+static void count_burst(packet_buffer_t **pkts, uint32_t count,
+                        packet_result_t *results, void *user_data) {
+    uint32_t *calls = (uint32_t *)user_data;
+    (*calls)++;
+    for (uint32_t i = 0; i < count; i++) {
+        results[i] = pkts[i]->size == 2 ? PACKET_RESULT_CONSUME : PACKET_RESULT_FORWARD;
+    }
+}
+
+void test_packet_process_burst() {
+    const uint8_t byte = 0;
+    packet_buffer_t *pkts[PACKET_BURST_MAX + 4];
+    packet_result_t results[PACKET_BURST_MAX + 4];
+    uint32_t n = PACKET_BURST_MAX + 4;
+    uint32_t burst_calls = 0;
+    uint32_t h1, h2;
+
+    assert(packet_register_processor(drop_odd_size, 10, NULL, &h1) == STATUS_SUCCESS);
+    assert(packet_register_burst_processor(count_burst, 20, &burst_calls, &h2) == STATUS_SUCCESS);
+
+    for (uint32_t i = 0; i < n; i++) {
+        pkts[i] = packet_buffer_alloc(64);
+        for (uint32_t b = 0; b < i % 4; b++) {
+            packet_append_data(pkts[i], &byte, 1);
+        }
+    }
+
+    assert(packet_process_burst(pkts, n, results) == STATUS_SUCCESS);
+    // One call per chunk of PACKET_BURST_MAX
+    assert(burst_calls == 2);
+    for (uint32_t i = 0; i < n; i++) {
+        switch (i % 4) {
+            case 1: case 3: assert(results[i] == PACKET_RESULT_DROP); break;
+            case 2: assert(results[i] == PACKET_RESULT_CONSUME); break;
+            default: assert(results[i] == PACKET_RESULT_FORWARD); break;
+        }
+        packet_buffer_free(pkts[i]);
+    }
+
+    // Burst processors are also used by single-packet processing
+    packet_buffer_t *single = packet_buffer_alloc(64);
+    packet_append_data(single, &byte, 1);
+    packet_append_data(single, &byte, 1);
+    assert(packet_process(single) == PACKET_RESULT_CONSUME);
+    assert(burst_calls == 3);
+    packet_buffer_free(single);
+
+    packet_unregister_processor(h2);
+    packet_unregister_processor(h1);
+    printf(TEST_PASSED, "test_packet_process_burst");
+}
+
+static packet_result_t record_order(packet_buffer_t *packet, void *user_data) {
+    // Append the processor tag so the packet carries the visiting order
+    uint8_t tag = (uint8_t)(uintptr_t)user_data;
+    packet_append_data(packet, &tag, 1);
+    return PACKET_RESULT_FORWARD;
+}
+
+void test_packet_processor_registry() {
+    uint32_t h_low, h_high, h_mid;
+
+    // Registered out of priority order; handles must stay valid
+    assert(packet_register_processor(record_order, 30, (void *)(uintptr_t)3, &h_low) == STATUS_SUCCESS);
+    assert(packet_register_processor(record_order, 10, (void *)(uintptr_t)1, &h_high) == STATUS_SUCCESS);
+    assert(packet_register_processor(record_order, 20, (void *)(uintptr_t)2, &h_mid) == STATUS_SUCCESS);
+
+    packet_buffer_t *packet = packet_buffer_alloc(64);
+    assert(packet_process(packet) == PACKET_RESULT_FORWARD);
+    assert(packet->size == 3);
+    assert(packet->data[0] == 1 && packet->data[1] == 2 && packet->data[2] == 3);
+
+    // Unregistering by the original handle removes exactly that processor
+    assert(packet_unregister_processor(h_high) == STATUS_SUCCESS);
+    packet_reset(packet);
+    assert(packet_process(packet) == PACKET_RESULT_FORWARD);
+    assert(packet->size == 2);
+    assert(packet->data[0] == 2 && packet->data[1] == 3);
+
+    assert(packet_unregister_processor(h_high) == STATUS_INVALID_PARAMETER);
+    assert(packet_unregister_processor(h_low) == STATUS_SUCCESS);
+    assert(packet_unregister_processor(h_mid) == STATUS_SUCCESS);
+
+    packet_reset(packet);
+    assert(packet_process(packet) == PACKET_RESULT_FORWARD);
+    assert(packet->size == 0);
+    packet_buffer_free(packet);
+
+    printf(TEST_PASSED, "test_packet_processor_registry");
+}
+
+void test_packet_parse() {
+    // Broadcast, 802.1Q VID 100 PCP 5, IPv4 with options, UDP
+    uint8_t frame[] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+        0x81, 0x00, 0xA0, 0x64, 0x08, 0x00,
+        0x46, 0x00, 0x00, 0x24, 0x00, 0x00, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00,
+        0x0A, 0x00, 0x00, 0x01, 0x0A, 0x00, 0x00, 0x02, 0x01, 0x01, 0x01, 0x01,
+        0x04, 0x00, 0x00, 0x35, 0x00, 0x08, 0x00, 0x00
+    };
+    packet_buffer_t *packet = packet_buffer_alloc(128);
+    packet_append_data(packet, frame, sizeof(frame));
+
+    assert(!packet_is_parsed(packet));
+    assert(packet_ensure_parsed(packet) == STATUS_SUCCESS);
+    assert(packet_parsed_has(packet, PACKET_PARSED_L2 | PACKET_PARSED_L3 | PACKET_PARSED_L4));
+    assert(packet_has_proto(packet, PACKET_PROTO_VLAN));
+    assert(packet_has_proto(packet, PACKET_PROTO_L2_BCAST));
+    assert(packet_has_proto(packet, PACKET_PROTO_IPV4 | PACKET_PROTO_IP_OPTIONS));
+    assert(packet_has_proto(packet, PACKET_PROTO_UDP));
+    assert(!packet_has_proto(packet, PACKET_PROTO_QINQ | PACKET_PROTO_IP_FRAG));
+    assert(packet_ethertype(packet) == ETHERTYPE_IP);
+    assert(packet->metadata.vlan == 100 && packet->metadata.priority == 5);
+    assert(packet_l3_offset(packet) == 18);
+    assert(packet_l4_offset(packet) == 42);
+    assert(packet_l4_header(packet)[3] == 0x35);
+
+    vlan_id_t vid = 0;
+    assert(packet_has_vlan_tag(packet, &vid) && vid == 100);
+
+    // Tag push/pop shift the cache instead of dropping it
+    assert(packet_vlan_pop(packet, NULL) == STATUS_SUCCESS);
+    assert(packet_parsed_has(packet, PACKET_PARSED_L2 | PACKET_PARSED_L3 | PACKET_PARSED_L4));
+    assert(packet->metadata.vlan_count == 0 && !packet_has_proto(packet, PACKET_PROTO_VLAN));
+    assert(packet_l3_offset(packet) == 14 && packet_l4_offset(packet) == 38);
+
+    assert(packet_qinq_push(packet, 0x0C8, 0x064) == STATUS_SUCCESS);
+    assert(packet_has_proto(packet, PACKET_PROTO_QINQ));
+    assert(packet->metadata.vlan_tpid[0] == ETHERTYPE_QINQ && packet->metadata.vlan_tci[0] == 0x0C8);
+    assert(packet->metadata.vlan_tpid[1] == ETHERTYPE_VLAN && packet->metadata.vlan_tci[1] == 0x064);
+    assert(packet_l3_offset(packet) == 22 && packet_l4_offset(packet) == 46);
+
+    // A reparse agrees with the shifted cache
+    packet_metadata_t cached = packet->metadata;
+    assert(packet_parse(packet) == STATUS_SUCCESS);
+    assert(packet->metadata.vlan_count == cached.vlan_count);
+    assert(packet->metadata.proto_flags == cached.proto_flags);
+    assert(packet_l3_offset(packet) == cached.l3_offset && packet_l4_offset(packet) == cached.l4_offset);
+
+    // Other data changes still drop it
+    packet_update_data(packet, 30, "\x00", 1);
+    assert(!packet_is_parsed(packet));
+    packet_buffer_free(packet);
+
+    // IPv6 with a hop-by-hop header in front of TCP
+    uint8_t frame6[14 + 40 + 8 + 20] = {
+        0x33, 0x33, 0x00, 0x00, 0x00, 0x01, 0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+        0x86, 0xDD, 0x60
+    };
+    frame6[14 + 6] = 0;     // next header: hop-by-hop
+    frame6[14 + 40] = 6;    // then TCP
+    packet = packet_buffer_alloc(128);
+    packet_append_data(packet, frame6, sizeof(frame6));
+    assert(packet_parse(packet) == STATUS_SUCCESS);
+    assert(packet_has_proto(packet, PACKET_PROTO_L2_MCAST | PACKET_PROTO_IPV6));
+    assert(packet_has_proto(packet, PACKET_PROTO_IP_OPTIONS | PACKET_PROTO_TCP));
+    assert(packet->metadata.l4_proto == 6 && packet_l4_offset(packet) == 62);
+    assert(!packet_has_proto(packet, PACKET_PROTO_IPV6_ROUTING));
+    packet_buffer_free(packet);
+
+    // IPv6 with a routing header and an AH in front of UDP
+    uint8_t frame6r[14 + 40 + 8 + 16 + 8] = {
+        0x33, 0x33, 0x00, 0x00, 0x00, 0x01, 0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+        0x86, 0xDD, 0x60
+    };
+    frame6r[14 + 6] = 43;           // next header: routing
+    frame6r[14 + 40] = 51;          // then AH
+    frame6r[14 + 48] = 17;          // then UDP
+    frame6r[14 + 48 + 1] = 2;       // AH of (2 + 2) * 4 octets
+    packet = packet_buffer_alloc(128);
+    packet_append_data(packet, frame6r, sizeof(frame6r));
+    assert(packet_parse(packet) == STATUS_SUCCESS);
+    assert(packet_has_proto(packet, PACKET_PROTO_IPV6_ROUTING));
+    assert(packet_has_proto(packet, PACKET_PROTO_IP_OPTIONS | PACKET_PROTO_UDP));
+    assert(!packet_has_proto(packet, PACKET_PROTO_IP_FRAG));
+    assert(packet->metadata.l4_proto == 17 && packet_l4_offset(packet) == 78);
+    packet_buffer_free(packet);
+
+    // MPLS: label 100 TTL 64 over label 200 (bottom of stack) TTL 63
+    uint8_t frame_mpls[14 + 8 + 20] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x66, 0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+        0x88, 0x47, 0x00, 0x06, 0x40, 0x40, 0x00, 0x0C, 0x81, 0x3F, 0x45
+    };
+    packet = packet_buffer_alloc(128);
+    packet_append_data(packet, frame_mpls, sizeof(frame_mpls));
+    assert(packet_parse(packet) == STATUS_SUCCESS);
+    assert(packet_has_proto(packet, PACKET_PROTO_MPLS));
+    assert(packet_parsed_has(packet, PACKET_PARSED_MPLS));
+    assert(!packet_has_proto(packet, PACKET_PROTO_IPV4));
+    assert(packet->metadata.mpls_count == 2 && packet_l3_offset(packet) == 14);
+    assert((packet->metadata.mpls_stack[0] >> 12) == 100);
+    assert((packet->metadata.mpls_stack[1] >> 12) == 200 && (packet->metadata.mpls_stack[1] & 0x100));
+    packet_buffer_free(packet);
+
+    packet = packet_buffer_alloc(128);
+    packet_append_data(packet, frame6r, sizeof(frame6r));
+
+    // Truncated frames parse to the last complete layer
+    packet->size = 30;
+    assert(packet_parse(packet) == STATUS_SUCCESS);
+    assert(packet_parsed_has(packet, PACKET_PARSED_L2));
+    assert(!packet_parsed_has(packet, PACKET_PARSED_L3));
+    packet->size = 10;
+    assert(packet_parse(packet) == STATUS_INVALID_PACKET);
+    assert(packet_is_parsed(packet) && !packet_parsed_has(packet, PACKET_PARSED_L2));
+    packet_buffer_free(packet);
+
+    printf(TEST_PASSED, "test_packet_parse");
+}
+
+void test_packet_flow_hash() {
+    // IPv4/UDP 10.0.0.1:1024 -> 10.0.0.2:53
+    uint8_t frame[14 + 20 + 8] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x66, 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x08, 0x00,
+        0x45, 0x00, 0x00, 0x1C, 0x00, 0x00, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00,
+        0x0A, 0x00, 0x00, 0x01, 0x0A, 0x00, 0x00, 0x02,
+        0x04, 0x00, 0x00, 0x35, 0x00, 0x08, 0x00, 0x00
+    };
+    packet_buffer_t *a = packet_buffer_alloc(128);
+    packet_buffer_t *b = packet_buffer_alloc(128);
+    packet_append_data(a, frame, sizeof(frame));
+    packet_append_data(b, frame, sizeof(frame));
+
+    // Same flow, same hash; the MAC addresses do not matter for IP
+    b->data[5] = 0x77;
+    assert(packet_flow_hash(a) == packet_flow_hash(b));
+    assert(packet_parsed_has(a, PACKET_PARSED_HASH));
+
+    // A different source port is a different flow
+    packet_update_data(b, 35, "\x01", 1);
+    assert(!packet_parsed_has(b, PACKET_PARSED_HASH));
+    assert(packet_flow_hash(a) != packet_flow_hash(b));
+
+    // Fragments ignore the ports and stay with the datagram
+    uint8_t mf = 0x20;
+    packet_update_data(a, 20, &mf, 1);
+    packet_update_data(b, 20, &mf, 1);
+    assert(packet_flow_hash(a) == packet_flow_hash(b));
+
+    packet_buffer_free(a);
+    packet_buffer_free(b);
+    printf(TEST_PASSED, "test_packet_flow_hash");
+}
+
+void test_packet_segment_chain() {
+    const uint32_t len = CONFIG_PACKET_SEGMENT_SIZE * 2 + 100;
+    uint8_t *payload = (uint8_t *)malloc(len);
+    uint8_t *copy = (uint8_t *)malloc(len);
+    const uint8_t patch[4] = {0xA1, 0xA2, 0xA3, 0xA4};
+    packet_pool_stats_t stats;
+    uint8_t byte;
+
+    for (uint32_t i = 0; i < len; i++) {
+        payload[i] = (uint8_t)(i * 7);
+    }
+
+    packet_buffer_t *pkt = packet_segment_alloc();
+    assert(pkt != NULL);
+    assert(pkt->flags & PACKET_FLAG_SEGMENT);
+    packet_get_pool_stats(&stats);
+    assert(stats.seg_in_use == 1);
+
+    // Appending past one segment links more segments
+    assert(packet_append_data(pkt, payload, len) == STATUS_SUCCESS);
+    assert(packet_is_chained(pkt));
+    assert(packet_segment_count(pkt) == 3);
+    assert(packet_chain_length(pkt) == len);
+    assert(pkt->size == CONFIG_PACKET_SEGMENT_SIZE);
+
+    // Reads and writes cross segment boundaries
+    const uint32_t edge = CONFIG_PACKET_SEGMENT_SIZE - 2;
+    assert(packet_copy_data(pkt, 0, copy, len) == STATUS_SUCCESS);
+    assert(memcmp(copy, payload, len) == 0);
+    assert(packet_peek_byte(pkt, len - 1, &byte) == STATUS_SUCCESS);
+    assert(byte == payload[len - 1]);
+    assert(packet_update_data(pkt, edge, patch, sizeof(patch)) == STATUS_SUCCESS);
+    assert(packet_peek_data(pkt, edge, copy, sizeof(patch)) == STATUS_SUCCESS);
+    assert(memcmp(copy, patch, sizeof(patch)) == 0);
+    assert(pkt->next->data[1] == patch[3]);
+    assert(packet_copy_data(pkt, len - 10, copy, 11) != STATUS_SUCCESS);
+    memcpy(payload + edge, patch, sizeof(patch));
+
+    // A shared clone shares every segment
+    packet_buffer_t *clone = packet_buffer_clone_shared(pkt);
+    assert(clone != NULL);
+    assert(packet_segment_count(clone) == 3);
+    assert(clone->next->data == pkt->next->data);
+
+    // Linearize gathers the chain into one buffer
+    assert(packet_linearize(pkt) == STATUS_SUCCESS);
+    assert(!packet_is_chained(pkt));
+    assert(pkt->size == len);
+    assert(memcmp(pkt->data, payload, len) == 0);
+    assert(packet_copy_data(clone, 0, copy, len) == STATUS_SUCCESS);
+    assert(memcmp(copy, payload, len) == 0);
+
+    packet_buffer_free(pkt);
+    packet_buffer_free(clone);
+    packet_get_pool_stats(&stats);
+    assert(stats.in_use == 0);
+    assert(stats.seg_in_use == 0);
+
+    free(payload);
+    free(copy);
+    printf(TEST_PASSED, "test_packet_segment_chain");
+}
+
+void test_packet_slice() {
+    const uint32_t len = CONFIG_PACKET_SEGMENT_SIZE + 500;
+    uint8_t *payload = (uint8_t *)malloc(len);
+    uint8_t *copy = (uint8_t *)malloc(len);
+    const uint8_t patch = 0x5A;
+    packet_pool_stats_t stats;
+
+    for (uint32_t i = 0; i < len; i++) {
+        payload[i] = (uint8_t)(i ^ 0x3C);
+    }
+
+    packet_buffer_t *pkt = packet_segment_alloc();
+    assert(packet_append_data(pkt, payload, len) == STATUS_SUCCESS);
+
+    // A slice spanning the segment boundary references the original bytes
+    const uint32_t start = CONFIG_PACKET_SEGMENT_SIZE - 100;
+    packet_buffer_t *slice = packet_buffer_slice(pkt, start, 300);
+    assert(slice != NULL);
+    assert(packet_segment_count(slice) == 2);
+    assert(packet_chain_length(slice) == 300);
+    assert(slice->data == pkt->data + start);
+    assert(slice->next->data == pkt->next->data);
+    assert(packet_copy_data(slice, 0, copy, 300) == STATUS_SUCCESS);
+    assert(memcmp(copy, payload + start, 300) == 0);
+
+    // Writing the slice leaves the original alone
+    assert(packet_update_data(slice, 0, &patch, 1) == STATUS_SUCCESS);
+    assert(slice->data[0] == patch);
+    assert(pkt->data[start] == payload[start]);
+
+    assert(packet_buffer_slice(pkt, len - 10, 11) == NULL);
+    assert(packet_buffer_slice(pkt, 0, 0) == NULL);
+
+    // Joining slices rebuilds the original without copying
+    packet_buffer_t *head = packet_buffer_slice(pkt, 0, 1000);
+    packet_buffer_t *tail = packet_buffer_slice(pkt, 1000, len - 1000);
+    assert(head && tail);
+    assert(packet_chain_append(head, tail) == STATUS_SUCCESS);
+    assert(packet_chain_length(head) == len);
+    assert(packet_copy_data(head, 0, copy, len) == STATUS_SUCCESS);
+    assert(memcmp(copy, payload, len) == 0);
+
+    // Data stays alive until the last slice goes
+    packet_buffer_free(pkt);
+    assert(packet_copy_data(head, 0, copy, len) == STATUS_SUCCESS);
+    assert(memcmp(copy, payload, len) == 0);
+    packet_buffer_free(head);
+    packet_buffer_free(slice);
+    packet_get_pool_stats(&stats);
+    assert(stats.in_use == 0);
+    assert(stats.seg_in_use == 0);
+
+    free(payload);
+    free(copy);
+    printf(TEST_PASSED, "test_packet_slice");
+}
+
+void test_packet_peek_ptr() {
+    const uint32_t len = CONFIG_PACKET_SEGMENT_SIZE + 200;
+    const uint32_t edge = CONFIG_PACKET_SEGMENT_SIZE - 8;
+    uint8_t *payload = (uint8_t *)malloc(len);
+    const uint8_t *views[PACKET_PEEK_SCRATCH_SLOTS];
+    packet_pool_stats_t stats;
+    const uint8_t *ptr;
+    uint8_t *wptr;
+
+    for (uint32_t i = 0; i < len; i++) {
+        payload[i] = (uint8_t)(i * 13);
+    }
+
+    packet_buffer_t *pkt = packet_segment_alloc();
+    assert(packet_append_data(pkt, payload, len) == STATUS_SUCCESS);
+    assert(packet_segment_count(pkt) == 2);
+
+    // A range inside one segment is returned in place
+    assert(packet_peek_ptr(pkt, 10, 20) == pkt->data + 10);
+    assert(packet_peek_ptr(pkt, CONFIG_PACKET_SEGMENT_SIZE + 4, 16) == pkt->next->data + 4);
+
+    // A spanning range is linearized; each slot holds until reused
+    for (uint32_t i = 0; i < PACKET_PEEK_SCRATCH_SLOTS; i++) {
+        views[i] = packet_peek_ptr(pkt, edge - i, 16);
+        assert(views[i] != NULL);
+        assert(views[i] != pkt->data + edge - i);
+    }
+    for (uint32_t i = 0; i < PACKET_PEEK_SCRATCH_SLOTS; i++) {
+        assert(memcmp(views[i], payload + edge - i, 16) == 0);
+    }
+    assert(packet_peek_ptr(pkt, edge, 16) == views[0]);
+
+    // Out of bounds, or too long to linearize
+    assert(packet_peek_ptr(pkt, len - 4, 5) == NULL);
+    assert(packet_peek_ptr(pkt, edge, PACKET_PEEK_SCRATCH_SIZE + 1) == NULL);
+    assert(packet_peek_ptr(NULL, 0, 1) == NULL);
+
+    // Writing through a clone's pointer leaves the original alone
+    packet_buffer_t *clone = packet_buffer_clone_shared(pkt);
+    assert(clone != NULL);
+    wptr = (uint8_t *)packet_write_ptr(clone, CONFIG_PACKET_SEGMENT_SIZE + 4, 4);
+    assert(wptr != NULL && wptr != pkt->next->data + 4);
+    wptr[0] = (uint8_t)~payload[CONFIG_PACKET_SEGMENT_SIZE + 4];
+    ptr = (const uint8_t *)packet_peek_ptr(pkt, CONFIG_PACKET_SEGMENT_SIZE + 4, 1);
+    assert(ptr[0] == payload[CONFIG_PACKET_SEGMENT_SIZE + 4]);
+    ptr = (const uint8_t *)packet_peek_ptr(clone, CONFIG_PACKET_SEGMENT_SIZE + 4, 1);
+    assert(ptr == wptr);
+
+    // Only a range inside one segment can be written in place
+    assert(packet_write_ptr(clone, edge, 16) == NULL);
+    assert(packet_write_ptr(clone, len - 4, 5) == NULL);
+
+    packet_buffer_free(clone);
+    packet_buffer_free(pkt);
+    packet_get_pool_stats(&stats);
+    assert(stats.in_use == 0);
+    assert(stats.seg_in_use == 0);
+
+    free(payload);
+    printf(TEST_PASSED, "test_packet_peek_ptr");
+}
+
+int main() {
+    printf("Running Packet unit tests...\n");
+
+    assert(packet_init() == STATUS_SUCCESS);
+
+    test_packet_pool_alloc_free();
+    test_packet_pool_oversize();
+    test_packet_pool_exhaustion();
+    test_packet_pool_thread_flush();
+    test_packet_pool_resize();
+    test_packet_push_pull_header();
+    test_packet_vlan_push_pop();
+    test_packet_clone_shared();
+    test_packet_clone_shared_owner_write();
+    test_packet_segment_chain();
+    test_packet_slice();
+    test_packet_peek_ptr();
+    test_packet_process_burst();
+    test_packet_processor_registry();
+    test_packet_parse();
+    test_packet_flow_hash();
+
+    packet_shutdown();
+
+    printf("All Packet tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,224 @@
+/**
+ * @file test_packet_drop.c
+ * @brief Unit tests for drop counters and sampled drop capture
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/hal/packet_drop.h"
+#include "../../include/hal/packet.h"
+#include "../../include/common/config.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define FRAME_LEN 100
+
+/* A frame whose first byte tells it apart */
+static packet_buffer_t *make_packet(uint8_t tag, port_id_t port) {
+    uint8_t frame[FRAME_LEN];
+    packet_buffer_t *pkt = packet_buffer_alloc(FRAME_LEN);
+
+    assert(pkt != NULL);
+    memset(frame, 0, sizeof(frame));
+    frame[0] = tag;
+    frame[FRAME_LEN - 1] = 0xEE;
+    assert(packet_append_data(pkt, frame, FRAME_LEN) == STATUS_SUCCESS);
+    pkt->metadata.port = port;
+    pkt->metadata.direction = PACKET_DIR_RX;
+    return pkt;
+}
+
+static uint64_t drops(packet_drop_reason_t reason) {
+    uint64_t counts[PACKET_DROP_REASON_COUNT];
+
+    assert(packet_drop_get_counters(counts) == STATUS_SUCCESS);
+    return counts[reason];
+}
+
+static packet_result_t drop_silently(packet_buffer_t *packet, void *user_data) {
+    (void)packet;
+    (void)user_data;
+    return PACKET_RESULT_DROP;
+}
+
+static packet_result_t drop_acl(packet_buffer_t *packet, void *user_data) {
+    (void)user_data;
+    packet_drop_count(packet, PACKET_DROP_ACL_DENY);
+    return PACKET_RESULT_DROP;
+}
+
+static packet_result_t recirculate(packet_buffer_t *packet, void *user_data) {
+    (void)packet;
+    (void)user_data;
+    return PACKET_RESULT_RECIRCULATE;
+}
+
+void test_packet_drop_counters() {
+    packet_buffer_t *pkts[4];
+    uint64_t counts[PACKET_DROP_REASON_COUNT];
+
+    packet_drop_set_sample_rate(0);
+    packet_drop_clear_counters();
+    assert(packet_drop_get_counters(NULL) == STATUS_INVALID_PARAMETER);
+
+    // A packet is counted under the first reason it is dropped for
+    pkts[0] = make_packet(1, 1);
+    packet_drop_count(pkts[0], PACKET_DROP_TTL_EXCEEDED);
+    packet_drop_count(pkts[0], PACKET_DROP_NO_ROUTE);
+    assert(pkts[0]->metadata.drop_reason == PACKET_DROP_TTL_EXCEEDED);
+    assert(drops(PACKET_DROP_TTL_EXCEEDED) == 1 && drops(PACKET_DROP_NO_ROUTE) == 0);
+    packet_buffer_free(pkts[0]);
+
+    // Drops of data already gone are counted every time
+    packet_drop_count(NULL, PACKET_DROP_INVALID);
+    packet_drop_count(NULL, PACKET_DROP_INVALID);
+    assert(drops(PACKET_DROP_INVALID) == 2);
+
+    // No reason or a bad one is an internal error
+    packet_drop_count(NULL, PACKET_DROP_NONE);
+    packet_drop_count(NULL, PACKET_DROP_REASON_COUNT);
+    assert(drops(PACKET_DROP_INTERNAL) == 2 && drops(PACKET_DROP_NONE) == 0);
+
+    // A burst is counted from the first dropped packet on
+    for (int i = 0; i < 4; i++) {
+        pkts[i] = make_packet((uint8_t)i, 2);
+    }
+    packet_drop_count_burst(pkts, 1, 4, PACKET_DROP_TX_RING_FULL);
+    assert(drops(PACKET_DROP_TX_RING_FULL) == 3);
+    assert(pkts[0]->metadata.drop_reason == PACKET_DROP_NONE);
+    for (int i = 0; i < 4; i++) {
+        packet_buffer_free(pkts[i]);
+    }
+
+    // Clearing sets every reason back to zero
+    packet_drop_clear_counters();
+    assert(packet_drop_get_counters(counts) == STATUS_SUCCESS);
+    for (int i = 0; i < PACKET_DROP_REASON_COUNT; i++) {
+        assert(counts[i] == 0);
+    }
+
+    // Every reason has a name
+    for (int i = 0; i < PACKET_DROP_REASON_COUNT; i++) {
+        assert(packet_drop_reason_name((packet_drop_reason_t)i) != NULL);
+    }
+    assert(strcmp(packet_drop_reason_name(PACKET_DROP_ACL_DENY), "acl-deny") == 0);
+    assert(strcmp(packet_drop_reason_name(PACKET_DROP_REASON_COUNT), "unknown") == 0);
+
+    printf(TEST_PASSED, "test_packet_drop_counters");
+}
+
+void test_packet_drop_capture() {
+    packet_drop_record_t records[CONFIG_PACKET_DROP_CAPTURE_SIZE];
+    packet_buffer_t *pkt;
+    uint32_t n;
+
+    // Off by default and when set to 0
+    assert(packet_drop_get_sample_rate() == 0);
+    packet_drop_clear_capture();
+    pkt = make_packet(0x10, 1);
+    packet_drop_count(pkt, PACKET_DROP_PORT_DOWN);
+    packet_buffer_free(pkt);
+    assert(packet_drop_read_capture(records, CONFIG_PACKET_DROP_CAPTURE_SIZE) == 0);
+
+    // One drop in every rate is kept, with its first bytes
+    packet_drop_set_sample_rate(3);
+    for (uint8_t i = 0; i < 9; i++) {
+        pkt = make_packet(i, 5);
+        pkt->metadata.vlan = 100;
+        packet_drop_count(pkt, PACKET_DROP_STP_BLOCKED);
+        packet_buffer_free(pkt);
+    }
+    n = packet_drop_read_capture(records, CONFIG_PACKET_DROP_CAPTURE_SIZE);
+    assert(n == 3);
+    for (uint32_t i = 0; i < n; i++) {
+        assert(records[i].reason == PACKET_DROP_STP_BLOCKED);
+        assert(records[i].port == 5 && records[i].vlan == 100 && records[i].direction == PACKET_DIR_RX);
+        assert(records[i].length == FRAME_LEN && records[i].captured == PACKET_DROP_CAPTURE_BYTES);
+        assert(records[i].data[0] == i * 3 + 2);
+    }
+    assert(records[0].time_ns <= records[2].time_ns);
+
+    // A short read gets the newest, oldest first
+    assert(packet_drop_read_capture(records, 2) == 2);
+    assert(records[0].data[0] == 5 && records[1].data[0] == 8);
+    assert(packet_drop_read_capture(NULL, 2) == 0);
+
+    // The ring keeps the newest drops
+    packet_drop_set_sample_rate(1);
+    packet_drop_clear_capture();
+    for (uint32_t i = 0; i < CONFIG_PACKET_DROP_CAPTURE_SIZE + 10; i++) {
+        pkt = make_packet((uint8_t)i, 1);
+        packet_drop_count(pkt, PACKET_DROP_QOS_QUEUE);
+        packet_buffer_free(pkt);
+    }
+    n = packet_drop_read_capture(records, CONFIG_PACKET_DROP_CAPTURE_SIZE);
+    assert(n == CONFIG_PACKET_DROP_CAPTURE_SIZE);
+    assert(records[0].data[0] == 10);
+    assert(records[n - 1].data[0] == (uint8_t)(CONFIG_PACKET_DROP_CAPTURE_SIZE + 9));
+
+    packet_drop_clear_capture();
+    assert(packet_drop_read_capture(records, CONFIG_PACKET_DROP_CAPTURE_SIZE) == 0);
+    packet_drop_set_sample_rate(0);
+
+    printf(TEST_PASSED, "test_packet_drop_capture");
+}
+
+void test_packet_drop_pipeline() {
+    packet_buffer_t *pkt;
+    uint32_t handle;
+
+    packet_drop_clear_counters();
+
+    // A stage that drops without saying why is counted as the pipeline's
+    assert(packet_register_processor(drop_silently, 10, NULL, &handle) == STATUS_SUCCESS);
+    pkt = make_packet(1, 1);
+    assert(packet_process(pkt) == PACKET_RESULT_DROP);
+    assert(pkt->metadata.drop_reason == PACKET_DROP_PIPELINE);
+    packet_buffer_free(pkt);
+    assert(packet_unregister_processor(handle) == STATUS_SUCCESS);
+
+    // One that names its reason is counted once, under it
+    assert(packet_register_processor(drop_acl, 10, NULL, &handle) == STATUS_SUCCESS);
+    pkt = make_packet(1, 1);
+    assert(packet_process(pkt) == PACKET_RESULT_DROP);
+    packet_buffer_free(pkt);
+    assert(packet_unregister_processor(handle) == STATUS_SUCCESS);
+
+    // Endless recirculation is cut off
+    assert(packet_register_processor(recirculate, 10, NULL, &handle) == STATUS_SUCCESS);
+    pkt = make_packet(1, 1);
+    assert(packet_process(pkt) == PACKET_RESULT_DROP);
+    packet_buffer_free(pkt);
+    assert(packet_unregister_processor(handle) == STATUS_SUCCESS);
+
+    assert(drops(PACKET_DROP_PIPELINE) == 1);
+    assert(drops(PACKET_DROP_ACL_DENY) == 1);
+    assert(drops(PACKET_DROP_RECIRC_LIMIT) == 1);
+
+    printf(TEST_PASSED, "test_packet_drop_pipeline");
+}
+
+int main() {
+    uint64_t counts[PACKET_DROP_REASON_COUNT];
+
+    printf("Running packet drop unit tests...\n");
+
+    // The counters come and go with the packet subsystem
+    assert(packet_drop_get_counters(counts) == STATUS_NOT_INITIALIZED);
+    assert(packet_init() == STATUS_SUCCESS);
+    assert(packet_drop_get_sample_rate() == CONFIG_PACKET_DROP_SAMPLE_RATE);
+
+    test_packet_drop_counters();
+    test_packet_drop_capture();
+    test_packet_drop_pipeline();
+
+    assert(packet_shutdown() == STATUS_SUCCESS);
+    assert(packet_drop_get_counters(counts) == STATUS_NOT_INITIALIZED);
+
+    printf("All packet drop tests completed successfully.\n");
+    return 0;
+}
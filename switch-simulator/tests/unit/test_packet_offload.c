@@ -0,0 +1,287 @@
+/**
+ * @file test_packet_offload.c
+ * @brief Unit tests for checksum and TCP segmentation offload
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/hal/packet_offload.h"
+#include "../../include/hal/packet.h"
+#include "../../include/hal/driver.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define ETH_LEN 14
+#define IP_LEN 20
+#define IP6_LEN 40
+#define TCP_LEN 20
+#define UDP_LEN 8
+#define PAYLOAD_LEN 3001
+#define MSS 1000
+#define FIRST_SEG_PAYLOAD 101      /* Odd, so the chain splits the summed range at an odd byte */
+#define TCP_SEQ 0x10000000u
+
+#define TCP_FIN 0x01
+#define TCP_PSH 0x08
+#define TCP_ACK 0x10
+#define TCP_CWR 0x80
+
+static uint8_t g_frame[ETH_LEN + IP6_LEN + TCP_LEN + PAYLOAD_LEN];
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static uint16_t get16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+
+/* Ethernet, IPv4 or IPv6, then a transport header with zero checksums; returns the length */
+static uint32_t build_frame(bool ipv6, uint8_t proto, uint32_t payload_len) {
+    uint32_t l4_hdr = proto == 6 ? TCP_LEN : UDP_LEN;
+    uint32_t l3 = ETH_LEN;
+    uint32_t l4 = l3 + (ipv6 ? IP6_LEN : IP_LEN);
+    uint8_t *ip = g_frame + l3;
+    uint8_t *th = g_frame + l4;
+
+    memset(g_frame, 0, sizeof(g_frame));
+    memset(g_frame, 0x02, 6);
+    memset(g_frame + 6, 0x04, 6);
+    put16(g_frame + 12, ipv6 ? 0x86DD : 0x0800);
+    if (ipv6) {
+        ip[0] = 0x60;
+        put16(ip + 4, (uint16_t)(l4_hdr + payload_len));
+        ip[6] = proto;
+        ip[7] = 64;
+        ip[8] = 0x20;
+        ip[9] = 0x01;
+        ip[23] = 1;
+        ip[24] = 0x20;
+        ip[25] = 0x01;
+        ip[39] = 2;
+    } else {
+        ip[0] = 0x45;
+        put16(ip + 2, (uint16_t)(IP_LEN + l4_hdr + payload_len));
+        put16(ip + 4, 0x1234);
+        ip[8] = 64;
+        ip[9] = proto;
+        put16(ip + 12, 0x0A00);
+        put16(ip + 14, 0x0001);
+        put16(ip + 16, 0xC0A8);
+        put16(ip + 18, 0x0001);
+    }
+    put16(th, 40000);
+    put16(th + 2, 80);
+    if (proto == 6) {
+        put16(th + 4, TCP_SEQ >> 16);
+        put16(th + 6, TCP_SEQ & 0xFFFF);
+        th[12] = (TCP_LEN / 4) << 4;
+        th[13] = TCP_ACK | TCP_PSH | TCP_FIN | TCP_CWR;
+        put16(th + 14, 65535);
+    } else {
+        put16(th + 4, (uint16_t)(UDP_LEN + payload_len));
+    }
+    for (uint32_t i = 0; i < payload_len; i++) {
+        th[l4_hdr + i] = (uint8_t)(i * 7 + 1);
+    }
+    return l4 + l4_hdr + payload_len;
+}
+
+/* The frame in two buffers, split split bytes into it */
+static packet_buffer_t *make_chain(uint32_t len, uint32_t split) {
+    packet_buffer_t *head = packet_buffer_alloc(split);
+    packet_buffer_t *tail = packet_buffer_alloc(len - split);
+
+    assert(head != NULL && tail != NULL);
+    assert(packet_append_data(head, g_frame, split) == STATUS_SUCCESS);
+    assert(packet_append_data(tail, g_frame + split, len - split) == STATUS_SUCCESS);
+    assert(packet_chain_append(head, tail) == STATUS_SUCCESS);
+    return head;
+}
+
+static uint16_t rx_verdict(packet_buffer_t *packet) {
+    packet_offload_rx(packet);
+    return packet->metadata.offload & PACKET_OFFLOAD_RX_MASK;
+}
+
+void test_packet_csum() {
+    // RFC 1071, section 3
+    const uint8_t words[] = { 0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7 };
+    const uint8_t odd[] = { 0x01, 0x02, 0x03 };
+
+    assert(packet_csum_add(0, words, sizeof(words)) == 0x2ddf0);
+    assert(packet_csum_fold(0x2ddf0) == (uint16_t)~0xddf2);
+
+    // A running sum carries on where it stopped; an odd tail is padded
+    assert(packet_csum_add(packet_csum_add(0, words, 4), words + 4, 4) == 0x2ddf0);
+    assert(packet_csum_add(0, odd, sizeof(odd)) == 0x0102 + 0x0300);
+    assert(packet_csum_fold(0) == 0xFFFF);
+
+    printf(TEST_PASSED, "test_packet_csum");
+}
+
+void test_packet_offload_csum() {
+    uint32_t len = build_frame(false, 6, PAYLOAD_LEN);
+    uint32_t split = ETH_LEN + IP_LEN + TCP_LEN + FIRST_SEG_PAYLOAD;
+    packet_buffer_t *pkt = make_chain(len, split);
+    packet_buffer_t *udp;
+    uint8_t header[ETH_LEN + IP_LEN + UDP_LEN];
+    uint32_t count;
+
+    // Left for the driver, the checksums are wrong on the wire
+    pkt->metadata.offload = PACKET_OFFLOAD_IP_CSUM | PACKET_OFFLOAD_L4_CSUM;
+    assert(packet_offload_resolve(pkt, DRIVER_FLAG_TX_CSUM) == STATUS_SUCCESS);
+    assert(pkt->metadata.offload == (PACKET_OFFLOAD_IP_CSUM | PACKET_OFFLOAD_L4_CSUM));
+    assert(rx_verdict(pkt) == PACKET_OFFLOAD_RX_BAD);
+
+    // A port without checksum offload gets them done in software, over the chain
+    pkt->metadata.offload = PACKET_OFFLOAD_IP_CSUM | PACKET_OFFLOAD_L4_CSUM;
+    assert(packet_offload_resolve(pkt, 0) == STATUS_SUCCESS);
+    assert((pkt->metadata.offload & PACKET_OFFLOAD_TX_MASK) == 0);
+    assert(rx_verdict(pkt) == (PACKET_OFFLOAD_RX_IP_GOOD | PACKET_OFFLOAD_RX_L4_GOOD));
+
+    // A flipped payload byte in the second buffer is caught
+    pkt->next->data[7] ^= 0x40;
+    assert(rx_verdict(pkt) == (PACKET_OFFLOAD_RX_IP_GOOD | PACKET_OFFLOAD_RX_BAD));
+    packet_buffer_free(pkt);
+
+    // The emulated NIC fills them in on transmission just the same
+    pkt = make_chain(len, split);
+    pkt->metadata.offload = PACKET_OFFLOAD_IP_CSUM | PACKET_OFFLOAD_L4_CSUM;
+    assert(packet_offload_tx(pkt, NULL, 0, &count) == STATUS_SUCCESS && count == 0);
+    assert(rx_verdict(pkt) == (PACKET_OFFLOAD_RX_IP_GOOD | PACKET_OFFLOAD_RX_L4_GOOD));
+    packet_buffer_free(pkt);
+
+    // IPv6 has no header checksum; UDP over it is checked all the same
+    len = build_frame(true, 17, 333);
+    pkt = make_chain(len, ETH_LEN + IP6_LEN + UDP_LEN + 33);
+    pkt->metadata.offload = PACKET_OFFLOAD_L4_CSUM;
+    assert(packet_offload_resolve(pkt, 0) == STATUS_SUCCESS);
+    assert(rx_verdict(pkt) == PACKET_OFFLOAD_RX_L4_GOOD);
+    packet_buffer_free(pkt);
+
+    // An IPv4 datagram without a UDP checksum is accepted
+    len = build_frame(false, 17, 64);
+    udp = packet_buffer_alloc(len);
+    assert(udp != NULL);
+    assert(packet_append_data(udp, g_frame, len) == STATUS_SUCCESS);
+    udp->metadata.offload = PACKET_OFFLOAD_IP_CSUM;
+    assert(packet_offload_resolve(udp, 0) == STATUS_SUCCESS);
+    assert(rx_verdict(udp) == (PACKET_OFFLOAD_RX_IP_GOOD | PACKET_OFFLOAD_RX_L4_GOOD));
+    assert(packet_copy_data(udp, 0, header, sizeof(header)) == STATUS_SUCCESS);
+    assert(get16(header + ETH_LEN + IP_LEN + 6) == 0);
+    packet_buffer_free(udp);
+
+    printf(TEST_PASSED, "test_packet_offload_csum");
+}
+
+void test_packet_offload_tso() {
+    uint32_t len = build_frame(false, 6, PAYLOAD_LEN);
+    uint32_t split = ETH_LEN + IP_LEN + TCP_LEN + FIRST_SEG_PAYLOAD;
+    uint32_t nsegs = (PAYLOAD_LEN + MSS - 1) / MSS;
+    packet_buffer_t *pkt = make_chain(len, split);
+    packet_buffer_t *segs[PACKET_TSO_MAX_SEGS];
+    uint8_t header[ETH_LEN + IP_LEN + TCP_LEN];
+    uint8_t byte;
+    uint32_t count;
+
+    pkt->metadata.offload = PACKET_OFFLOAD_TSO | PACKET_OFFLOAD_IP_CSUM | PACKET_OFFLOAD_L4_CSUM;
+    pkt->metadata.tso_mss = MSS;
+
+    // Only a segmenting driver takes a TSO frame
+    assert(packet_offload_resolve(pkt, DRIVER_FLAG_TX_CSUM) == STATUS_NOT_SUPPORTED);
+    assert(packet_offload_resolve(pkt, DRIVER_FLAG_TSO) == STATUS_SUCCESS);
+    assert(packet_offload_tx(pkt, segs, nsegs - 1, &count) == STATUS_RESOURCE_EXCEEDED);
+
+    // Each segment is a frame of its own with the payload shared
+    assert(packet_offload_tx(pkt, segs, PACKET_TSO_MAX_SEGS, &count) == STATUS_SUCCESS);
+    assert(count == nsegs);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t seg_payload = i + 1 < count ? MSS : PAYLOAD_LEN - i * MSS;
+        const uint8_t *ip = header + ETH_LEN;
+        const uint8_t *tcp = ip + IP_LEN;
+
+        assert(packet_chain_length(segs[i]) == ETH_LEN + IP_LEN + TCP_LEN + seg_payload);
+        assert((segs[i]->metadata.offload & PACKET_OFFLOAD_TX_MASK) == 0);
+        assert(packet_copy_data(segs[i], 0, header, sizeof(header)) == STATUS_SUCCESS);
+        assert(get16(ip + 2) == IP_LEN + TCP_LEN + seg_payload);
+        assert(get16(ip + 4) == 0x1234 + i);
+        assert(get32(tcp + 4) == TCP_SEQ + i * MSS);
+
+        // FIN and PSH go with the last segment, CWR with the first
+        assert(((tcp[13] & (TCP_FIN | TCP_PSH)) != 0) == (i + 1 == count));
+        assert(((tcp[13] & TCP_CWR) != 0) == (i == 0));
+        assert((tcp[13] & TCP_ACK) != 0);
+
+        assert(packet_copy_data(segs[i], sizeof(header), &byte, 1) == STATUS_SUCCESS);
+        assert(byte == (uint8_t)(i * MSS * 7 + 1));
+        assert(rx_verdict(segs[i]) == (PACKET_OFFLOAD_RX_IP_GOOD | PACKET_OFFLOAD_RX_L4_GOOD));
+        packet_buffer_free(segs[i]);
+    }
+
+    // A frame within one MSS only gets its checksums
+    pkt->metadata.tso_mss = PAYLOAD_LEN;
+    assert(packet_offload_tx(pkt, segs, PACKET_TSO_MAX_SEGS, &count) == STATUS_SUCCESS);
+    assert(count == 0 && (pkt->metadata.offload & PACKET_OFFLOAD_TX_MASK) == 0);
+    assert(rx_verdict(pkt) == (PACKET_OFFLOAD_RX_IP_GOOD | PACKET_OFFLOAD_RX_L4_GOOD));
+    packet_buffer_free(pkt);
+
+    // TSO is for TCP only
+    len = build_frame(false, 17, PAYLOAD_LEN);
+    pkt = make_chain(len, split);
+    pkt->metadata.offload = PACKET_OFFLOAD_TSO;
+    pkt->metadata.tso_mss = MSS;
+    assert(packet_offload_tx(pkt, segs, PACKET_TSO_MAX_SEGS, &count) == STATUS_INVALID_PACKET);
+    packet_buffer_free(pkt);
+
+    printf(TEST_PASSED, "test_packet_offload_tso");
+}
+
+void test_packet_offload_errors() {
+    packet_buffer_t *pkt = packet_buffer_alloc(64);
+    uint8_t junk[64];
+    uint32_t count;
+
+    assert(packet_offload_resolve(NULL, 0) == STATUS_INVALID_PARAMETER);
+    assert(packet_offload_tx(NULL, NULL, 0, &count) == STATUS_INVALID_PARAMETER);
+    packet_offload_rx(NULL);
+
+    // Nothing pending is nothing to do, whatever the frame
+    memset(junk, 0xEE, sizeof(junk));
+    assert(pkt != NULL);
+    assert(packet_append_data(pkt, junk, sizeof(junk)) == STATUS_SUCCESS);
+    assert(packet_offload_resolve(pkt, 0) == STATUS_SUCCESS);
+
+    // Without IP headers there is nothing to fill in or check
+    pkt->metadata.offload = PACKET_OFFLOAD_IP_CSUM;
+    assert(packet_offload_resolve(pkt, 0) == STATUS_INVALID_PACKET);
+    assert(rx_verdict(pkt) == 0);
+    packet_buffer_free(pkt);
+
+    printf(TEST_PASSED, "test_packet_offload_errors");
+}
+
+int main() {
+    printf("Running packet offload unit tests...\n");
+
+    assert(packet_init() == STATUS_SUCCESS);
+
+    test_packet_csum();
+    test_packet_offload_csum();
+    test_packet_offload_tso();
+    test_packet_offload_errors();
+
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All packet offload tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,400 @@
+/**
+ * @file test_pcap_driver.c
+ * @brief Unit tests for pcap replay and egress capture
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <time.h>
+#include "../../drivers/include/pcap_driver.h"
+#include "../../include/hal/hw_simulation.h"
+#include "../../include/hal/hw_resources.h"
+#include "../../include/hal/packet.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define FRAME_LEN 60
+#define NUM_FRAMES 8
+#define REPLAY_PORT 1
+#define OTHER_PORT 2
+#define CAPTURE_PORT 3
+#define CAPTURE_SNAPLEN 32
+#define WAIT_POLLS 1000
+
+static uint8_t g_file[4096];
+static size_t g_len;
+static char g_path[] = "/tmp/test_pcap_driver_XXXXXX";
+
+static void put16(uint16_t value) {
+    memcpy(g_file + g_len, &value, sizeof(value));
+    g_len += sizeof(value);
+}
+
+static void put32(uint32_t value) {
+    memcpy(g_file + g_len, &value, sizeof(value));
+    g_len += sizeof(value);
+}
+
+static void put_bytes(const void *data, size_t len) {
+    memcpy(g_file + g_len, data, len);
+    g_len += len;
+    while (g_len & 3) {
+        g_file[g_len++] = 0;
+    }
+}
+
+/* A frame whose first payload byte tells it apart */
+static void make_frame(uint8_t *frame, uint8_t tag) {
+    memset(frame, 0, FRAME_LEN);
+    memset(frame, 0x02, 6);
+    memset(frame + 6, 0x04, 6);
+    frame[12] = 0x88;
+    frame[13] = 0xB5;
+    frame[14] = tag;
+}
+
+static void write_file(void) {
+    FILE *file = fopen(g_path, "wb");
+
+    assert(file != NULL);
+    assert(fwrite(g_file, 1, g_len, file) == g_len);
+    assert(fclose(file) == 0);
+}
+
+/* pcapng block: type, total length, body, total length again */
+static size_t begin_block(uint32_t type) {
+    size_t start = g_len;
+
+    put32(type);
+    put32(0);
+    return start;
+}
+
+static void end_block(size_t start) {
+    uint32_t total = (uint32_t)(g_len - start + 4);
+
+    put32(total);
+    memcpy(g_file + start + 4, &total, sizeof(total));
+}
+
+static void put_option(uint16_t code, const char *value) {
+    put16(code);
+    put16((uint16_t)strlen(value));
+    put_bytes(value, strlen(value));
+}
+
+static void put_interface(const char *name) {
+    size_t blk = begin_block(0x00000001);
+
+    put16(1);       /* Ethernet */
+    put16(0);
+    put32(0);
+    put_option(2, name);
+    put32(0);       /* End of options */
+    end_block(blk);
+}
+
+static void put_epb(uint32_t if_id, uint64_t ts_us, uint8_t tag) {
+    uint8_t frame[FRAME_LEN];
+    size_t blk = begin_block(0x00000006);
+
+    make_frame(frame, tag);
+    put32(if_id);
+    put32((uint32_t)(ts_us >> 32));
+    put32((uint32_t)ts_us);
+    put32(FRAME_LEN);
+    put32(FRAME_LEN);
+    put_bytes(frame, FRAME_LEN);
+    end_block(blk);
+}
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void bring_up(port_id_t port) {
+    port_config_t config;
+    port_state_t state;
+
+    // The simulated link comes up at random once the port is enabled
+    assert(hw_sim_get_port_config(port, &config) == STATUS_SUCCESS);
+    config.admin_state = true;
+    do {
+        assert(hw_sim_set_port_config(port, &config) == STATUS_SUCCESS);
+        assert(hw_sim_get_port_state(port, &state) == STATUS_SUCCESS);
+    } while (state != PORT_STATE_UP);
+}
+
+static void wait_done(pcap_replay_t *replay, pcap_replay_stats_t *stats) {
+    for (int i = 0; i < WAIT_POLLS; i++) {
+        pcap_replay_get_stats(replay, stats);
+        if (stats->done) {
+            return;
+        }
+        usleep(1000);
+    }
+    assert(stats->done);
+}
+
+/* Take what the port received and return the tags in order */
+static uint32_t rx_tags(port_id_t port, uint8_t *tags, uint32_t max) {
+    packet_buffer_t *pkts[NUM_FRAMES * 2];
+    uint32_t n = hw_sim_rx_dequeue_burst(port, pkts, NUM_FRAMES * 2);
+
+    assert(n <= max);
+    for (uint32_t i = 0; i < n; i++) {
+        assert(pkts[i]->length == FRAME_LEN);
+        tags[i] = pkts[i]->data[14];
+        packet_buffer_free(pkts[i]);
+    }
+    return n;
+}
+
+void test_pcap_replay() {
+    pcap_replay_config_t config = { .port = REPLAY_PORT, .timing = PCAP_REPLAY_MAX_RATE, .burst = 3 };
+    pcap_replay_t *replay;
+    pcap_replay_stats_t stats;
+    uint8_t frame[FRAME_LEN];
+    uint8_t tags[NUM_FRAMES * 2];
+    char comment[16];
+    size_t length;
+    uint32_t i;
+
+    // Microsecond pcap: frames, one too short for Ethernet, then a cut-off record
+    g_len = 0;
+    put32(0xa1b2c3d4);
+    put32(2 | (4u << 16));
+    put32(0);
+    put32(0);
+    put32(65535);
+    put32(1);
+    for (i = 0; i < NUM_FRAMES; i++) {
+        make_frame(frame, (uint8_t)(0xA0 + i));
+        put32(1);
+        put32(i * 10);
+        put32(FRAME_LEN);
+        put32(FRAME_LEN);
+        put_bytes(frame, FRAME_LEN);
+        if (i == 3) {
+            put32(1);
+            put32(35);
+            put32(8);
+            put32(8);
+            put_bytes(frame, 8);
+        }
+    }
+    put32(2);
+    put32(0);
+    put32(FRAME_LEN);
+    put32(FRAME_LEN);
+    write_file();
+
+    assert(pcap_replay_open(g_path, &replay) == STATUS_SUCCESS);
+    assert(pcap_replay_get_comment(replay, comment, sizeof(comment), &length) == STATUS_NOT_FOUND);
+    assert(pcap_replay_start(replay, &config) == STATUS_SUCCESS);
+    wait_done(replay, &stats);
+    assert(stats.packets == NUM_FRAMES && stats.bytes == NUM_FRAMES * FRAME_LEN);
+    assert(stats.skipped == 2 && stats.dropped == 0 && stats.loops == 1);
+
+    // Frames arrive in file order, bursts notwithstanding
+    assert(rx_tags(REPLAY_PORT, tags, NUM_FRAMES) == NUM_FRAMES);
+    for (i = 0; i < NUM_FRAMES; i++) {
+        assert(tags[i] == 0xA0 + i);
+    }
+
+    // A running replay cannot be started again; a looping one is stopped
+    assert(pcap_replay_start(replay, &config) == STATUS_RESOURCE_BUSY);
+    pcap_replay_stop(replay);
+    config.loop = true;
+    assert(pcap_replay_start(replay, &config) == STATUS_SUCCESS);
+    for (i = 0; i < WAIT_POLLS; i++) {
+        pcap_replay_get_stats(replay, &stats);
+        if (stats.loops >= 1) {
+            break;
+        }
+        usleep(1000);
+    }
+    pcap_replay_stop(replay);
+    pcap_replay_get_stats(replay, &stats);
+    assert(stats.loops >= 1 && !stats.done);
+    while (rx_tags(REPLAY_PORT, tags, NUM_FRAMES * 2) > 0) {
+    }
+
+    pcap_replay_close(replay);
+    unlink(g_path);
+    printf(TEST_PASSED, "test_pcap_replay");
+}
+
+void test_pcap_replay_pcapng() {
+    pcap_replay_config_t config = { .port = REPLAY_PORT, .timing = PCAP_REPLAY_ORIGINAL, .by_interface = true };
+    pcap_replay_t *replay;
+    pcap_replay_stats_t stats;
+    uint8_t tags[NUM_FRAMES];
+    char comment[16];
+    size_t length;
+    uint64_t start;
+    size_t blk;
+
+    // A section with a comment, interfaces "port2", "eth0" and "port1"
+    g_len = 0;
+    blk = begin_block(0x0A0D0D0A);
+    put32(0x1A2B3C4D);
+    put16(1);
+    put16(0);
+    put32(0xFFFFFFFF);
+    put32(0xFFFFFFFF);
+    put_option(1, "lab run 7");
+    put32(0);
+    end_block(blk);
+    put_interface("port2");
+    put_interface("eth0");
+    put_interface("port1");
+    put_epb(0, 1000000, 0xB0);
+    put_epb(2, 1000000, 0xB1);
+    put_epb(1, 1010000, 0xB2);
+    put_epb(2, 1030000, 0xB3);
+    put_epb(0, 1030000, 0xB4);
+    write_file();
+
+    assert(pcap_replay_open(g_path, &replay) == STATUS_SUCCESS);
+    assert(pcap_replay_get_comment(replay, comment, sizeof(comment), &length) == STATUS_SUCCESS);
+    assert(length == strlen("lab run 7") && strcmp(comment, "lab run 7") == 0);
+    assert(pcap_replay_get_comment(replay, comment, 4, &length) == STATUS_SUCCESS);
+    assert(length == strlen("lab run 7") && strcmp(comment, "lab") == 0);
+
+    // Each frame goes to the port it was recorded on, 30 ms apart end to end
+    start = now_ms();
+    assert(pcap_replay_start(replay, &config) == STATUS_SUCCESS);
+    wait_done(replay, &stats);
+    assert(now_ms() - start >= 30);
+    assert(stats.packets == 4 && stats.skipped == 1);
+    assert(rx_tags(REPLAY_PORT, tags, NUM_FRAMES) == 2);
+    assert(tags[0] == 0xB1 && tags[1] == 0xB3);
+    assert(rx_tags(OTHER_PORT, tags, NUM_FRAMES) == 2);
+    assert(tags[0] == 0xB0 && tags[1] == 0xB4);
+
+    pcap_replay_close(replay);
+    unlink(g_path);
+    printf(TEST_PASSED, "test_pcap_replay_pcapng");
+}
+
+void test_pcap_capture() {
+    pcap_capture_config_t config = { .port = CAPTURE_PORT, .ring_size = 4096, .snaplen = CAPTURE_SNAPLEN };
+    pcap_capture_t *capture;
+    pcap_capture_stats_t stats;
+    port_config_t port_config;
+    packet_buffer_t *pkts[4];
+    uint8_t frame[FRAME_LEN];
+    uint32_t header[6];
+    uint32_t record[4];
+    uint8_t data[CAPTURE_SNAPLEN];
+    FILE *file;
+    uint32_t i;
+
+    assert(pcap_capture_open(g_path, &config, &capture) == STATUS_SUCCESS);
+    assert(hw_sim_get_port_config(CAPTURE_PORT, &port_config) == STATUS_SUCCESS);
+    assert(port_config.driver == pcap_capture_get_driver(capture));
+
+    // What the port sends is recorded on the way out
+    for (i = 0; i < 4; i++) {
+        make_frame(frame, (uint8_t)(0xC0 + i));
+        pkts[i] = packet_buffer_alloc(FRAME_LEN);
+        assert(pkts[i] != NULL);
+        assert(packet_append_data(pkts[i], frame, FRAME_LEN) == STATUS_SUCCESS);
+    }
+    assert(hw_sim_tx_enqueue_burst(CAPTURE_PORT, pkts, 4) == 4);
+    assert(hw_sim_tx_drain(CAPTURE_PORT, 64) == 4);
+    pcap_capture_get_stats(capture, &stats);
+    assert(stats.packets == 4 && stats.bytes == 4 * FRAME_LEN && stats.dropped == 0);
+
+    // Closing hands the port back and leaves a complete file
+    pcap_capture_close(capture);
+    assert(hw_sim_get_port_config(CAPTURE_PORT, &port_config) == STATUS_SUCCESS);
+    assert(port_config.driver == NULL);
+
+    file = fopen(g_path, "rb");
+    assert(file != NULL);
+    assert(fread(header, sizeof(header), 1, file) == 1);
+    assert(header[0] == 0xa1b23c4d && header[4] == CAPTURE_SNAPLEN && header[5] == 1);
+    for (i = 0; i < 4; i++) {
+        assert(fread(record, sizeof(record), 1, file) == 1);
+        assert(record[2] == CAPTURE_SNAPLEN && record[3] == FRAME_LEN);
+        assert(fread(data, sizeof(data), 1, file) == 1);
+        assert(data[14] == 0xC0 + i);
+    }
+    assert(fread(data, 1, 1, file) == 0);
+    assert(fclose(file) == 0);
+
+    unlink(g_path);
+    printf(TEST_PASSED, "test_pcap_capture");
+}
+
+void test_pcap_errors() {
+    pcap_capture_config_t capture_config = { .port = CAPTURE_PORT, .ring_size = 1000 };
+    pcap_replay_config_t replay_config = { .port = REPLAY_PORT };
+    pcap_replay_t *replay;
+    pcap_capture_t *capture;
+
+    assert(pcap_replay_open(NULL, &replay) == STATUS_INVALID_PARAMETER);
+    assert(pcap_replay_open("/tmp/no-such-capture.pcap", &replay) == STATUS_NOT_FOUND);
+
+    // Neither pcap nor pcapng
+    g_len = 0;
+    put32(0x12345678);
+    put32(0);
+    put32(0);
+    put32(0);
+    put32(0);
+    put32(0);
+    write_file();
+    assert(pcap_replay_open(g_path, &replay) == STATUS_INVALID_PACKET);
+    assert(pcap_replay_start(NULL, &replay_config) == STATUS_INVALID_PARAMETER);
+    pcap_replay_close(NULL);
+
+    // The ring must be a power of two that holds two full records
+    assert(pcap_capture_open(g_path, &capture_config, &capture) == STATUS_INVALID_PARAMETER);
+    capture_config.ring_size = 64;
+    capture_config.snaplen = 64;
+    assert(pcap_capture_open(g_path, &capture_config, &capture) == STATUS_INVALID_PARAMETER);
+    capture_config.ring_size = 0;
+    capture_config.snaplen = 0;
+    assert(pcap_capture_open("/tmp/no-such-dir/capture.pcap", &capture_config, &capture) == STATUS_FAILURE);
+    pcap_capture_close(NULL);
+
+    unlink(g_path);
+    printf(TEST_PASSED, "test_pcap_errors");
+}
+
+int main() {
+    int fd;
+
+    printf("Running pcap driver unit tests...\n");
+
+    fd = mkstemp(g_path);
+    assert(fd >= 0);
+    close(fd);
+
+    assert(packet_init() == STATUS_SUCCESS);
+    assert(hw_sim_init() == STATUS_SUCCESS);
+    bring_up(REPLAY_PORT);
+    bring_up(OTHER_PORT);
+
+    test_pcap_replay();
+    test_pcap_replay_pcapng();
+    test_pcap_capture();
+    test_pcap_errors();
+
+    assert(hw_sim_shutdown() == STATUS_SUCCESS);
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All pcap driver tests completed successfully.\n");
+    return 0;
+}
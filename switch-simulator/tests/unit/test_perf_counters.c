@@ -0,0 +1,165 @@
+/**
+ * @file test_perf_counters.c
+ * @brief Unit tests for the hardware performance counter wrapper
+ *
+ * Containers and virtual machines often have no PMU, so the tests that
+ * read counters check what they can when none are available.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "../../include/common/perf_counters.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define LOOP 1000000
+
+static volatile uint64_t g_sink;
+
+static void busy_loop(void) {
+    for (uint32_t i = 0; i < LOOP; i++) {
+        g_sink += i;
+    }
+}
+
+static void *thread_group(void *arg) {
+    perf_counters_t **group = arg;
+
+    *group = perf_counters_thread();
+    return NULL;
+}
+
+void test_perf_sample_math() {
+    perf_sample_t start, end, delta, total;
+
+    memset(&start, 0, sizeof(start));
+    memset(&end, 0, sizeof(end));
+    memset(&total, 0, sizeof(total));
+    start.values[PERF_COUNTER_CYCLES] = 100;
+    end.values[PERF_COUNTER_CYCLES] = 300;
+    end.values[PERF_COUNTER_INSTRUCTIONS] = 500;
+    start.values[PERF_COUNTER_CACHE_MISSES] = 10;
+
+    // A counter that went backwards counts as zero
+    perf_sample_delta(&start, &end, &delta);
+    assert(delta.values[PERF_COUNTER_CYCLES] == 200);
+    assert(delta.values[PERF_COUNTER_INSTRUCTIONS] == 500);
+    assert(delta.values[PERF_COUNTER_CACHE_MISSES] == 0);
+    assert(perf_sample_ipc(&delta) == 2.5);
+
+    perf_sample_add(&total, &delta);
+    perf_sample_add(&total, &delta);
+    assert(total.values[PERF_COUNTER_CYCLES] == 400 && total.values[PERF_COUNTER_INSTRUCTIONS] == 1000);
+
+    memset(&delta, 0, sizeof(delta));
+    assert(perf_sample_ipc(&delta) == 0.0);
+
+    printf(TEST_PASSED, "test_perf_sample_math");
+}
+
+void test_perf_sample_bound() {
+    perf_sample_t sample;
+
+    memset(&sample, 0, sizeof(sample));
+    assert(strcmp(perf_sample_bound(NULL), "unknown") == 0);
+    assert(strcmp(perf_sample_bound(&sample), "unknown") == 0);
+
+    // The threshold is in misses per thousand instructions
+    sample.values[PERF_COUNTER_INSTRUCTIONS] = 1000;
+    sample.values[PERF_COUNTER_CACHE_MISSES] = CONFIG_PERF_MEMORY_BOUND_MPKI;
+    assert(strcmp(perf_sample_bound(&sample), "memory") == 0);
+    sample.values[PERF_COUNTER_CACHE_MISSES] = CONFIG_PERF_MEMORY_BOUND_MPKI - 1;
+    assert(strcmp(perf_sample_bound(&sample), "compute") == 0);
+
+    // Data TLB misses count on their own
+    sample.values[PERF_COUNTER_DTLB_MISSES] = CONFIG_PERF_MEMORY_BOUND_MPKI;
+    assert(strcmp(perf_sample_bound(&sample), "memory") == 0);
+
+    printf(TEST_PASSED, "test_perf_sample_bound");
+}
+
+void test_perf_counter_names() {
+    assert(strcmp(perf_counter_name(PERF_COUNTER_CYCLES), "cycles") == 0);
+    assert(strcmp(perf_counter_name(PERF_COUNTER_CACHE_MISSES), "llc-misses") == 0);
+    assert(strcmp(perf_counter_name(PERF_COUNTER_DTLB_MISSES), "dtlb-misses") == 0);
+    assert(strcmp(perf_counter_name(PERF_COUNTER_COUNT), "unknown") == 0);
+
+    printf(TEST_PASSED, "test_perf_counter_names");
+}
+
+void test_perf_counters_group() {
+    perf_counters_t pc;
+    perf_sample_t start, end, delta;
+    status_t status;
+
+    assert(perf_counters_open(NULL) == STATUS_INVALID_PARAMETER);
+    assert(perf_counters_read(NULL, &start) == STATUS_INVALID_PARAMETER);
+    perf_counters_close(NULL);
+
+    status = perf_counters_open(&pc);
+    if (status != STATUS_SUCCESS) {
+        // Without counters the group is closed and reads give zeros
+        assert(status == STATUS_NOT_SUPPORTED);
+        assert(pc.leader == -1 && pc.mask == 0);
+        assert(perf_counters_read(&pc, &start) == STATUS_NOT_SUPPORTED);
+        assert(start.values[PERF_COUNTER_CYCLES] == 0);
+        printf(TEST_PASSED, "test_perf_counters_group (no counters)");
+        return;
+    }
+
+    assert(pc.leader >= 0 && pc.nr > 0 && pc.mask != 0);
+    assert(perf_counters_read(&pc, &start) == STATUS_SUCCESS);
+    busy_loop();
+    assert(perf_counters_read(&pc, &end) == STATUS_SUCCESS);
+    perf_sample_delta(&start, &end, &delta);
+
+    // Events the CPU does not count stay zero
+    for (uint32_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (!(pc.mask & (1u << i))) {
+            assert(end.values[i] == 0);
+        }
+    }
+    if (pc.mask & (1u << PERF_COUNTER_INSTRUCTIONS)) {
+        assert(delta.values[PERF_COUNTER_INSTRUCTIONS] >= LOOP);
+    }
+
+    perf_counters_close(&pc);
+    assert(pc.leader == -1 && pc.mask == 0);
+    assert(perf_counters_read(&pc, &start) == STATUS_NOT_SUPPORTED);
+
+    printf(TEST_PASSED, "test_perf_counters_group");
+}
+
+void test_perf_counters_thread() {
+    perf_counters_t *mine = perf_counters_thread();
+    perf_counters_t *other = NULL;
+    pthread_t thread;
+
+    // The group is opened once per thread
+    assert(perf_counters_thread() == mine);
+
+    assert(pthread_create(&thread, NULL, thread_group, &other) == 0);
+    assert(pthread_join(thread, NULL) == 0);
+    assert((mine == NULL) == (other == NULL));
+    assert(mine == NULL || mine != other);
+
+    printf(TEST_PASSED, "test_perf_counters_thread");
+}
+
+int main() {
+    printf("Running perf counters unit tests...\n");
+
+    test_perf_sample_math();
+    test_perf_sample_bound();
+    test_perf_counter_names();
+    test_perf_counters_group();
+    test_perf_counters_thread();
+
+    printf("All perf counters tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,380 @@
+/**
+ * @file test_pim.c
+ * @brief Unit tests for the PIM-SM router
+ *
+ * Two routers on their own switch instances share one link: the upstream
+ * router is the RP, the downstream router has a host LAN. Messages sent
+ * on the link are queued and handed to the other router; messages sent
+ * on other interfaces go nowhere.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/l3/pim.h"
+#include "../../include/l3/mcast_fib.h"
+#include "../../include/hal/packet_offload.h"
+#include "../../include/hal/port_types.h"
+#include "../../include/common/switch_context.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define UP_INSTANCE 1
+#define DOWN_INSTANCE 2
+#define LINK_IF 0
+#define LAN_IF 1
+#define UP_LINK_ADDR 0x0A000101u        /* 10.0.1.1 */
+#define DOWN_LINK_ADDR 0x0A000102u      /* 10.0.1.2 */
+#define RP_ADDR 0x0A000901u             /* 10.0.9.1, on the upstream router */
+#define LAN_ADDR 0x0A000201u            /* 10.0.2.1 */
+#define GROUP 0xEF010203u               /* 239.1.2.3 */
+#define HELLO_MS 1000
+#define JOIN_PRUNE_MS 2000
+#define QUEUE_MAX 32
+
+/* One router and the messages it sent on the link */
+typedef struct {
+    pim_router_t *router;
+    uint32_t instance;
+    uint32_t link_addr;
+    uint32_t count;
+    uint32_t dropped;
+    uint8_t types[QUEUE_MAX];
+    uint16_t lengths[QUEUE_MAX];
+    uint8_t msgs[QUEUE_MAX][PIM_MAX_MESSAGE_LEN];
+} node_t;
+
+static node_t g_up;
+static node_t g_down;
+
+static status_t node_send(uint32_t ifindex, uint32_t dst, const uint8_t *msg, uint16_t length, void *ctx) {
+    node_t *node = ctx;
+
+    assert(dst == PIM_ALL_ROUTERS && length <= PIM_MAX_MESSAGE_LEN);
+    assert(packet_csum_fold(packet_csum_add(0, msg, length)) == 0);
+    if (ifindex != LINK_IF) {
+        node->dropped++;
+        return STATUS_SUCCESS;
+    }
+    assert(node->count < QUEUE_MAX);
+    node->types[node->count] = msg[0] & 0x0F;
+    node->lengths[node->count] = length;
+    memcpy(node->msgs[node->count++], msg, length);
+    return STATUS_SUCCESS;
+}
+
+/* The RP is across the link; everything else is unreachable */
+static status_t down_rpf(uint32_t address, uint32_t *ifindex, uint32_t *neighbor, void *ctx) {
+    (void)ctx;
+    if (address != RP_ADDR) {
+        return STATUS_NOT_FOUND;
+    }
+    *ifindex = LINK_IF;
+    *neighbor = UP_LINK_ADDR;
+    return STATUS_SUCCESS;
+}
+
+static status_t no_rpf(uint32_t address, uint32_t *ifindex, uint32_t *neighbor, void *ctx) {
+    (void)address;
+    (void)ifindex;
+    (void)neighbor;
+    (void)ctx;
+    return STATUS_NOT_FOUND;
+}
+
+static void node_bind(const node_t *node) {
+    assert(switch_context_bind(node->instance) == STATUS_SUCCESS);
+}
+
+/* Hand what one router queued to the other, until both are quiet */
+static void deliver(uint64_t now_ms) {
+    while (g_up.count || g_down.count) {
+        node_t *from = g_up.count ? &g_up : &g_down;
+        node_t *to = from == &g_up ? &g_down : &g_up;
+        uint8_t msg[PIM_MAX_MESSAGE_LEN];
+        uint16_t length = from->lengths[0];
+
+        memcpy(msg, from->msgs[0], length);
+        from->count--;
+        memmove(from->types, from->types + 1, from->count);
+        memmove(from->lengths, from->lengths + 1, from->count * sizeof(uint16_t));
+        memmove(from->msgs, from->msgs + 1, from->count * sizeof(from->msgs[0]));
+
+        node_bind(to);
+        assert(pim_input(to->router, LINK_IF, from->link_addr, msg, length, now_ms) == STATUS_SUCCESS);
+    }
+}
+
+/* Timers run on both routers, then each gets what the other sent */
+static void exchange(uint64_t now_ms) {
+    node_bind(&g_up);
+    pim_process_timers(g_up.router, now_ms);
+    node_bind(&g_down);
+    pim_process_timers(g_down.router, now_ms);
+    deliver(now_ms);
+}
+
+static void setup(void) {
+    pim_config_t up_config = { .hello_period_ms = HELLO_MS, .join_prune_period_ms = JOIN_PRUNE_MS,
+                               .send = node_send, .rpf = no_rpf, .ctx = &g_up };
+    pim_config_t down_config = { .hello_period_ms = HELLO_MS, .join_prune_period_ms = JOIN_PRUNE_MS,
+                                 .send = node_send, .rpf = down_rpf, .ctx = &g_down };
+    pim_interface_config_t itf = { 0 };
+    uint32_t ifindex;
+
+    memset(&g_up, 0, sizeof(g_up));
+    memset(&g_down, 0, sizeof(g_down));
+    g_up.instance = UP_INSTANCE;
+    g_up.link_addr = UP_LINK_ADDR;
+    g_down.instance = DOWN_INSTANCE;
+    g_down.link_addr = DOWN_LINK_ADDR;
+
+    // The upstream router has the lower address but the higher DR priority
+    node_bind(&g_up);
+    assert(mfib_init(0) == STATUS_SUCCESS);
+    g_up.router = pim_router_create(&up_config);
+    assert(g_up.router != NULL);
+    itf = (pim_interface_config_t){ .address = UP_LINK_ADDR, .port_id = 1, .vlan_id = 10, .dr_priority = 10 };
+    assert(pim_interface_add(g_up.router, &itf, &ifindex) == STATUS_SUCCESS && ifindex == LINK_IF);
+    itf = (pim_interface_config_t){ .address = RP_ADDR, .port_id = 2, .vlan_id = 20 };
+    assert(pim_interface_add(g_up.router, &itf, &ifindex) == STATUS_SUCCESS && ifindex == LAN_IF);
+    assert(pim_rp_add(g_up.router, 0xE0000000u, 4, RP_ADDR) == STATUS_SUCCESS);
+
+    node_bind(&g_down);
+    assert(mfib_init(0) == STATUS_SUCCESS);
+    g_down.router = pim_router_create(&down_config);
+    assert(g_down.router != NULL);
+    itf = (pim_interface_config_t){ .address = DOWN_LINK_ADDR, .port_id = 1, .vlan_id = 10 };
+    assert(pim_interface_add(g_down.router, &itf, &ifindex) == STATUS_SUCCESS && ifindex == LINK_IF);
+    itf = (pim_interface_config_t){ .address = LAN_ADDR, .port_id = 3, .vlan_id = 30, .tagged = true };
+    assert(pim_interface_add(g_down.router, &itf, &ifindex) == STATUS_SUCCESS && ifindex == LAN_IF);
+    assert(pim_rp_add(g_down.router, 0xE0000000u, 4, RP_ADDR) == STATUS_SUCCESS);
+}
+
+static void teardown(void) {
+    node_bind(&g_up);
+    pim_router_destroy(g_up.router);
+    assert(mfib_deinit() == STATUS_SUCCESS);
+    node_bind(&g_down);
+    pim_router_destroy(g_down.router);
+    assert(mfib_deinit() == STATUS_SUCCESS);
+    assert(switch_context_bind(SWITCH_INSTANCE_DEFAULT) == STATUS_SUCCESS);
+}
+
+void test_pim_config() {
+    pim_config_t config = { .send = node_send, .rpf = no_rpf, .ctx = &g_up };
+    pim_interface_config_t itf = { .address = UP_LINK_ADDR, .port_id = 1, .vlan_id = 10 };
+    pim_stats_t stats;
+    uint8_t msg[8] = { 0x20, 0, 0, 0, 0, 1, 0, 2 };
+    uint32_t ifindex;
+    pim_router_t *router;
+
+    memset(&g_up, 0, sizeof(g_up));
+    assert(pim_router_create(NULL) == NULL);
+    config.rpf = NULL;
+    assert(pim_router_create(&config) == NULL);
+    config.rpf = no_rpf;
+    router = pim_router_create(&config);
+    assert(router != NULL);
+
+    itf.address = 0;
+    assert(pim_interface_add(router, &itf, &ifindex) == STATUS_INVALID_PARAMETER);
+    itf.address = UP_LINK_ADDR;
+    assert(pim_interface_add(router, &itf, &ifindex) == STATUS_SUCCESS);
+    assert(pim_interface_remove(router, ifindex + 1) == STATUS_NOT_FOUND);
+
+    // RP ranges must be multicast, with a length of 4 to 32
+    assert(pim_rp_add(router, 0xE0000000u, 3, RP_ADDR) == STATUS_INVALID_PARAMETER);
+    assert(pim_rp_add(router, 0x0A000000u, 8, RP_ADDR) == STATUS_INVALID_PARAMETER);
+    assert(pim_rp_add(router, 0xE0000000u, 4, 0) == STATUS_INVALID_PARAMETER);
+    assert(pim_rp_remove(router, 0xE0000000u, 4) == STATUS_NOT_FOUND);
+
+    // An any-source join needs an RP
+    assert(pim_local_membership(router, ifindex, 0, 0x0A000001u, true) == STATUS_INVALID_PARAMETER);
+    assert(pim_local_membership(router, ifindex, 0, GROUP, true) == STATUS_INVALID_PARAMETER);
+    assert(pim_local_membership(router, ifindex + 1, 0, GROUP, true) == STATUS_NOT_FOUND);
+    assert(pim_local_membership(router, ifindex, 0, GROUP, false) == STATUS_NOT_FOUND);
+
+    // Too short, wrong version, bad checksum; a Register is only counted
+    assert(pim_input(router, ifindex, UP_LINK_ADDR, msg, 3, 0) == STATUS_INVALID_PACKET);
+    msg[0] = 0x10;
+    assert(pim_input(router, ifindex, UP_LINK_ADDR, msg, sizeof(msg), 0) == STATUS_INVALID_PACKET);
+    msg[0] = 0x20;
+    assert(pim_input(router, ifindex, UP_LINK_ADDR, msg, sizeof(msg), 0) == STATUS_INVALID_PACKET);
+    msg[0] = 0x20 | PIM_MSG_REGISTER;
+    assert(pim_input(router, ifindex, UP_LINK_ADDR, msg, sizeof(msg), 0) == STATUS_NOT_SUPPORTED);
+    assert(pim_input(router, ifindex + 1, UP_LINK_ADDR, msg, sizeof(msg), 0) == STATUS_NOT_FOUND);
+
+    assert(pim_get_stats(router, &stats) == STATUS_SUCCESS);
+    assert(stats.malformed == 3 && stats.unsupported == 1);
+    assert(stats.hellos_rx == 0 && stats.routes == 0);
+
+    pim_router_destroy(router);
+    pim_router_destroy(NULL);
+    printf(TEST_PASSED, "test_pim_config");
+}
+
+void test_pim_hello() {
+    pim_interface_info_t info;
+    pim_stats_t stats;
+
+    setup();
+
+    // Alone on the link, each router is DR
+    node_bind(&g_down);
+    assert(pim_get_interface(g_down.router, LINK_IF, &info) == STATUS_SUCCESS);
+    assert(info.neighbors == 0 && info.is_dr && info.dr_address == DOWN_LINK_ADDR);
+
+    // The first timer run sends a Hello on every interface
+    node_bind(&g_up);
+    pim_process_timers(g_up.router, 0);
+    assert(g_up.count == 1 && g_up.types[0] == PIM_MSG_HELLO && g_up.dropped == 1);
+    exchange(0);
+
+    // Priority wins over the higher address
+    node_bind(&g_up);
+    assert(pim_get_interface(g_up.router, LINK_IF, &info) == STATUS_SUCCESS);
+    assert(info.neighbors == 1 && info.is_dr && info.dr_address == UP_LINK_ADDR);
+    node_bind(&g_down);
+    assert(pim_get_interface(g_down.router, LINK_IF, &info) == STATUS_SUCCESS);
+    assert(info.neighbors == 1 && !info.is_dr && info.dr_address == UP_LINK_ADDR);
+    assert(pim_get_interface(g_down.router, LAN_IF, &info) == STATUS_SUCCESS);
+    assert(info.neighbors == 0 && info.is_dr);
+
+    // A new neighbor gets a Hello at once, not after a period
+    exchange(1);
+    assert(pim_get_stats(g_down.router, &stats) == STATUS_SUCCESS);
+    assert(stats.neighbors == 1 && stats.hellos_rx >= 2 && stats.hellos_tx >= 3);
+
+    // Without Hellos the neighbor times out after 3.5 periods, here 3 s
+    node_bind(&g_down);
+    pim_process_timers(g_down.router, 3999);
+    g_down.count = 0;
+    assert(pim_get_interface(g_down.router, LINK_IF, &info) == STATUS_SUCCESS);
+    assert(info.neighbors == 0 && info.is_dr);
+
+    // A Hello with a zero holdtime removes the neighbor at once
+    exchange(4000);
+    assert(pim_get_interface(g_down.router, LINK_IF, &info) == STATUS_SUCCESS);
+    assert(info.neighbors == 1 && !info.is_dr);
+    node_bind(&g_up);
+    assert(pim_interface_remove(g_up.router, LINK_IF) == STATUS_SUCCESS);
+    assert(pim_get_interface(g_up.router, LINK_IF, &info) == STATUS_NOT_FOUND);
+    deliver(4001);
+    assert(pim_get_interface(g_down.router, LINK_IF, &info) == STATUS_SUCCESS);
+    assert(info.neighbors == 0 && info.is_dr);
+
+    teardown();
+    printf(TEST_PASSED, "test_pim_hello");
+}
+
+void test_pim_join_prune() {
+    pim_route_info_t route;
+    mfib_route_t fib;
+    pim_stats_t stats;
+
+    setup();
+    exchange(0);
+    exchange(1);
+
+    // Members on an interface where the router is not DR do not count
+    node_bind(&g_down);
+    assert(pim_local_membership(g_down.router, LINK_IF, 0, GROUP, true) == STATUS_SUCCESS);
+    assert(pim_get_route(g_down.router, 0, GROUP, &route) == STATUS_NOT_FOUND);
+    assert(g_down.count == 0);
+
+    // A local member joins the shared tree towards the RP
+    assert(pim_local_membership(g_down.router, LAN_IF, 0, GROUP, true) == STATUS_SUCCESS);
+    assert(g_down.count == 1 && g_down.types[0] == PIM_MSG_JOIN_PRUNE);
+    assert(pim_get_route(g_down.router, 0, GROUP, &route) == STATUS_SUCCESS);
+    assert(route.rp == RP_ADDR && route.upstream_if == LINK_IF && route.upstream_neighbor == UP_LINK_ADDR);
+    assert(route.local == (1ULL << LAN_IF) && route.joined == 0 && route.oifs == (1ULL << LAN_IF));
+    assert(mfib_route_get(MFIB_ANY_SOURCE, GROUP, &fib) == STATUS_SUCCESS);
+    assert(fib.iif == 1 && fib.iif_vlan == 10 && fib.oif_count == 1);
+    assert(fib.oifs[0].port_id == 3 && fib.oifs[0].vlan_id == 30 && fib.oifs[0].tagged);
+    deliver(2);
+
+    // The RP is the root: no RPF interface, the link is the replication list
+    node_bind(&g_up);
+    assert(pim_get_route(g_up.router, 0, GROUP, &route) == STATUS_SUCCESS);
+    assert(route.upstream_if == PIM_NO_INTERFACE && route.upstream_neighbor == 0);
+    assert(route.joined == (1ULL << LINK_IF) && route.oifs == (1ULL << LINK_IF));
+    assert(mfib_route_get(MFIB_ANY_SOURCE, GROUP, &fib) == STATUS_SUCCESS);
+    assert(fib.iif == PORT_ID_INVALID && fib.oif_count == 1 && fib.oifs[0].port_id == 1);
+    assert(pim_get_stats(g_up.router, &stats) == STATUS_SUCCESS);
+    assert(stats.join_prunes_rx == 1 && stats.joins_rx == 1 && stats.routes == 1);
+
+    // The last member leaving prunes; with one neighbor the prune is immediate
+    node_bind(&g_down);
+    assert(pim_local_membership(g_down.router, LAN_IF, 0, GROUP, false) == STATUS_SUCCESS);
+    assert(g_down.count == 1 && g_down.types[0] == PIM_MSG_JOIN_PRUNE);
+    assert(pim_get_route(g_down.router, 0, GROUP, &route) == STATUS_NOT_FOUND);
+    assert(mfib_route_get(MFIB_ANY_SOURCE, GROUP, &fib) == STATUS_NOT_FOUND);
+    deliver(3);
+
+    node_bind(&g_up);
+    assert(pim_get_route(g_up.router, 0, GROUP, &route) == STATUS_NOT_FOUND);
+    assert(mfib_route_get(MFIB_ANY_SOURCE, GROUP, &fib) == STATUS_NOT_FOUND);
+    assert(pim_get_stats(g_up.router, &stats) == STATUS_SUCCESS);
+    assert(stats.prunes_rx == 1 && stats.routes == 0);
+
+    teardown();
+    printf(TEST_PASSED, "test_pim_join_prune");
+}
+
+void test_pim_timers() {
+    pim_route_info_t route;
+    mfib_route_t fib;
+    pim_stats_t stats;
+    uint64_t now;
+
+    setup();
+    exchange(0);
+    exchange(1);
+    node_bind(&g_down);
+    assert(pim_local_membership(g_down.router, LAN_IF, 0, GROUP, true) == STATUS_SUCCESS);
+    deliver(2);
+
+    // Periodic joins keep the state past its 7 s holdtime
+    for (now = 500; now <= 20000; now += 500) {
+        exchange(now);
+    }
+    node_bind(&g_up);
+    assert(pim_get_route(g_up.router, 0, GROUP, &route) == STATUS_SUCCESS);
+    assert(route.joined == (1ULL << LINK_IF));
+    assert(pim_get_stats(g_up.router, &stats) == STATUS_SUCCESS);
+    assert(stats.joins_rx >= 20000 / JOIN_PRUNE_MS - 1);
+
+    // Once the joins stop, the upstream state expires and leaves the FIB
+    for (; now <= 28000; now += 500) {
+        pim_process_timers(g_up.router, now);
+        g_up.count = 0;
+    }
+    assert(pim_get_route(g_up.router, 0, GROUP, &route) == STATUS_NOT_FOUND);
+    assert(mfib_route_get(MFIB_ANY_SOURCE, GROUP, &fib) == STATUS_NOT_FOUND);
+
+    // Destroying a router deletes the routes it programmed
+    node_bind(&g_down);
+    assert(mfib_route_get(MFIB_ANY_SOURCE, GROUP, &fib) == STATUS_SUCCESS);
+    pim_router_destroy(g_down.router);
+    g_down.router = NULL;
+    assert(mfib_route_get(MFIB_ANY_SOURCE, GROUP, &fib) == STATUS_NOT_FOUND);
+
+    teardown();
+    printf(TEST_PASSED, "test_pim_timers");
+}
+
+int main() {
+    printf("Running PIM unit tests...\n");
+
+    test_pim_config();
+    test_pim_hello();
+    test_pim_join_prune();
+    test_pim_timers();
+
+    printf("All PIM tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,261 @@
+/**
+ * @file test_policer.c
+ * @brief Unit tests for the srTCM and trTCM policers
+ *
+ * Rates are low enough that the buckets gain next to nothing while a test
+ * runs, so the colors of back-to-back frames follow from the burst sizes.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "../../include/hal/policer.h"
+#include "../../include/hal/packet.h"
+#include "../../include/common/config.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define POLICED_PORT 1
+#define OTHER_PORT 2
+#define POLICED_VLAN 20
+#define FRAME_LEN 100
+#define BURST 32
+#define CIR 1000                /* Bytes per second: a frame every 100 ms */
+
+static packet_buffer_t *make_frame(port_id_t port, vlan_id_t vlan) {
+    uint8_t frame[FRAME_LEN];
+    packet_buffer_t *packet;
+
+    memset(frame, 0x5a, sizeof(frame));
+    frame[12] = 0x08;
+    frame[13] = 0x00;
+    packet = packet_buffer_alloc(FRAME_LEN);
+    assert(packet != NULL);
+    assert(packet_append_data(packet, frame, FRAME_LEN) == STATUS_SUCCESS);
+    packet->metadata.port = port;
+    packet->metadata.vlan = vlan;
+    return packet;
+}
+
+/* Meter frames one by one and count them by the color they leave with */
+static void meter(uint32_t policer_id, uint32_t count, policer_color_t in, uint32_t colors[3]) {
+    memset(colors, 0, 3 * sizeof(colors[0]));
+    for (uint32_t i = 0; i < count; i++) {
+        packet_buffer_t *packet = make_frame(OTHER_PORT, 0);
+
+        packet->metadata.color = (uint8_t)in;
+        policer_police(policer_id, packet);
+        colors[packet->metadata.color]++;
+        packet_buffer_free(packet);
+    }
+}
+
+/* Run frames through the ingress pipeline; returns how many were forwarded */
+static uint32_t receive(port_id_t port, vlan_id_t vlan, uint32_t count) {
+    packet_buffer_t *pkts[BURST];
+    packet_result_t results[BURST];
+    uint32_t forwarded = 0;
+
+    assert(count <= BURST);
+    for (uint32_t i = 0; i < count; i++) {
+        pkts[i] = make_frame(port, vlan);
+    }
+    assert(packet_process_burst(pkts, count, results) == STATUS_SUCCESS);
+    for (uint32_t i = 0; i < count; i++) {
+        forwarded += results[i] == PACKET_RESULT_FORWARD;
+        packet_buffer_free(pkts[i]);
+    }
+    return forwarded;
+}
+
+void test_policer_config() {
+    policer_config_t config = { .mode = POLICER_MODE_SRTCM, .cir = CIR, .cbs = 1000,
+                                .red_action = POLICER_ACTION_DROP };
+    policer_stats_t stats;
+
+    assert(policer_set(1, &config) == STATUS_NOT_INITIALIZED);
+    assert(policer_get_stats(1, &stats) == STATUS_NOT_INITIALIZED);
+    assert(policer_init() == STATUS_SUCCESS);
+    assert(policer_init() == STATUS_ALREADY_INITIALIZED);
+
+    assert(policer_set(POLICER_NONE, &config) == STATUS_INVALID_PARAMETER);
+    assert(policer_set(CONFIG_MAX_POLICERS + 1, &config) == STATUS_INVALID_PARAMETER);
+    assert(policer_set(1, NULL) == STATUS_INVALID_PARAMETER);
+    config.cir = 0;
+    assert(policer_set(1, &config) == STATUS_INVALID_PARAMETER);
+    config.cir = POLICER_MAX_RATE + 1;
+    assert(policer_set(1, &config) == STATUS_INVALID_PARAMETER);
+    config.cir = CIR;
+    config.cbs = POLICER_MAX_BURST + 1;
+    assert(policer_set(1, &config) == STATUS_INVALID_PARAMETER);
+    config.cbs = 1000;
+
+    // The peak rate of a two-rate marker is at least the committed one
+    config.mode = POLICER_MODE_TRTCM;
+    config.pir = CIR - 1;
+    assert(policer_set(1, &config) == STATUS_INVALID_PARAMETER);
+    config.mode = POLICER_MODE_SRTCM;
+    config.red_action = POLICER_ACTION_DROP + 1;
+    assert(policer_set(1, &config) == STATUS_INVALID_PARAMETER);
+    config.red_action = POLICER_ACTION_DROP;
+
+    assert(policer_delete(1) == STATUS_NOT_FOUND);
+    assert(policer_attach_port(CONFIG_MAX_PORTS, PACKET_DIR_RX, 1) == STATUS_INVALID_PARAMETER);
+    assert(policer_attach_port(POLICED_PORT, PACKET_DIR_RX, CONFIG_MAX_POLICERS + 1) == STATUS_INVALID_PARAMETER);
+    assert(policer_get_stats(POLICER_NONE, &stats) == STATUS_INVALID_PARAMETER);
+
+    printf(TEST_PASSED, "test_policer_config");
+}
+
+void test_policer_srtcm() {
+    policer_config_t config = { .mode = POLICER_MODE_SRTCM, .cir = CIR, .cbs = 10 * FRAME_LEN,
+                                .ebs = 5 * FRAME_LEN, .red_action = POLICER_ACTION_DROP };
+    policer_stats_t stats;
+    uint32_t colors[3];
+
+    // CBS worth of green, EBS worth of yellow, and red from then on
+    assert(policer_set(1, &config) == STATUS_SUCCESS);
+    meter(1, 20, POLICER_COLOR_GREEN, colors);
+    assert(colors[POLICER_COLOR_GREEN] == 10 && colors[POLICER_COLOR_YELLOW] == 5 &&
+           colors[POLICER_COLOR_RED] == 5);
+    assert(policer_get_stats(1, &stats) == STATUS_SUCCESS);
+    assert(stats.green_packets == 10 && stats.green_bytes == 10 * FRAME_LEN);
+    assert(stats.yellow_packets == 5 && stats.red_packets == 5 && stats.dropped_packets == 5);
+
+    // Changing a policer fills its buckets and keeps its counters
+    assert(policer_set(1, &config) == STATUS_SUCCESS);
+    meter(1, 10, POLICER_COLOR_GREEN, colors);
+    assert(colors[POLICER_COLOR_GREEN] == 10);
+    assert(policer_get_stats(1, &stats) == STATUS_SUCCESS);
+    assert(stats.green_packets == 20);
+    assert(policer_clear_stats(1) == STATUS_SUCCESS);
+    assert(policer_get_stats(1, &stats) == STATUS_SUCCESS);
+    assert(stats.green_packets == 0 && stats.dropped_packets == 0);
+
+    // Color-aware: a yellow frame can at best stay yellow
+    config.color_aware = true;
+    assert(policer_set(1, &config) == STATUS_SUCCESS);
+    meter(1, 6, POLICER_COLOR_YELLOW, colors);
+    assert(colors[POLICER_COLOR_YELLOW] == 5 && colors[POLICER_COLOR_RED] == 1);
+    meter(1, 10, POLICER_COLOR_GREEN, colors);
+    assert(colors[POLICER_COLOR_GREEN] == 10);
+
+    // The committed bucket refills at CIR
+    config.color_aware = false;
+    config.cir = 100 * FRAME_LEN;
+    config.ebs = 0;
+    assert(policer_set(1, &config) == STATUS_SUCCESS);
+    meter(1, 11, POLICER_COLOR_GREEN, colors);
+    assert(colors[POLICER_COLOR_GREEN] == 10 && colors[POLICER_COLOR_RED] == 1);
+    usleep(50000);
+    meter(1, 3, POLICER_COLOR_GREEN, colors);
+    assert(colors[POLICER_COLOR_GREEN] == 3);
+
+    printf(TEST_PASSED, "test_policer_srtcm");
+}
+
+void test_policer_trtcm() {
+    policer_config_t config = { .mode = POLICER_MODE_TRTCM, .cir = CIR, .cbs = 5 * FRAME_LEN,
+                                .pir = 2 * CIR, .pbs = 10 * FRAME_LEN, .red_action = POLICER_ACTION_DROP };
+    policer_stats_t stats;
+    uint32_t colors[3];
+
+    // Green up to CBS, yellow up to PBS; red frames take from neither bucket
+    assert(policer_set(2, &config) == STATUS_SUCCESS);
+    meter(2, 15, POLICER_COLOR_GREEN, colors);
+    assert(colors[POLICER_COLOR_GREEN] == 5 && colors[POLICER_COLOR_YELLOW] == 5 &&
+           colors[POLICER_COLOR_RED] == 5);
+
+    // A yellow action of drop leaves only green
+    config.yellow_action = POLICER_ACTION_DROP;
+    assert(policer_set(2, &config) == STATUS_SUCCESS);
+    assert(policer_clear_stats(2) == STATUS_SUCCESS);
+    meter(2, 15, POLICER_COLOR_GREEN, colors);
+    assert(policer_get_stats(2, &stats) == STATUS_SUCCESS);
+    assert(stats.green_packets == 5 && stats.yellow_packets == 5 && stats.red_packets == 5);
+    assert(stats.dropped_packets == 10);
+
+    // Red in, red out, when color-aware
+    config.color_aware = true;
+    assert(policer_set(2, &config) == STATUS_SUCCESS);
+    meter(2, 3, POLICER_COLOR_RED, colors);
+    assert(colors[POLICER_COLOR_RED] == 3);
+
+    printf(TEST_PASSED, "test_policer_trtcm");
+}
+
+void test_policer_attach() {
+    policer_config_t config = { .mode = POLICER_MODE_SRTCM, .cir = CIR, .cbs = 4 * FRAME_LEN,
+                                .red_action = POLICER_ACTION_DROP };
+    packet_buffer_t *pkts[BURST];
+    policer_stats_t stats;
+    uint32_t passed;
+
+    assert(policer_set(3, &config) == STATUS_SUCCESS);
+    assert(policer_set(4, &config) == STATUS_SUCCESS);
+
+    // Ingress port: other ports are not metered
+    assert(policer_attach_port(POLICED_PORT, PACKET_DIR_RX, 3) == STATUS_SUCCESS);
+    assert(receive(POLICED_PORT, 0, 10) == 4);
+    assert(receive(OTHER_PORT, 0, 10) == 10);
+
+    // VLAN ingress: only frames that passed the port's policer are charged
+    assert(policer_attach_vlan(POLICED_VLAN, 4) == STATUS_SUCCESS);
+    assert(receive(POLICED_PORT, POLICED_VLAN, 10) == 0);
+    assert(policer_get_stats(4, &stats) == STATUS_SUCCESS);
+    assert(stats.green_packets + stats.red_packets == 0);
+    assert(receive(OTHER_PORT, POLICED_VLAN, 10) == 4);
+    assert(policer_attach_port(POLICED_PORT, PACKET_DIR_RX, POLICER_NONE) == STATUS_SUCCESS);
+    assert(policer_attach_vlan(POLICED_VLAN, POLICER_NONE) == STATUS_SUCCESS);
+    assert(receive(POLICED_PORT, POLICED_VLAN, 10) == 10);
+
+    // Egress: the frames that pass come first, in order
+    assert(policer_set(3, &config) == STATUS_SUCCESS);
+    assert(policer_attach_port(POLICED_PORT, PACKET_DIR_TX, 3) == STATUS_SUCCESS);
+    for (uint32_t i = 0; i < 6; i++) {
+        pkts[i] = make_frame(POLICED_PORT, 0);
+        pkts[i]->metadata.priority = (uint8_t)i;
+    }
+    passed = policer_egress_burst(POLICED_PORT, pkts, 6);
+    assert(passed == 4);
+    for (uint32_t i = 0; i < 6; i++) {
+        assert(i >= passed || pkts[i]->metadata.priority == i);
+        assert(i < passed || pkts[i]->metadata.color == POLICER_COLOR_RED);
+        packet_buffer_free(pkts[i]);
+    }
+    assert(policer_egress_burst(OTHER_PORT, pkts, 0) == 0);
+
+    // A deleted policer meters nothing, though it stays attached
+    assert(policer_delete(3) == STATUS_SUCCESS);
+    for (uint32_t i = 0; i < 6; i++) {
+        pkts[i] = make_frame(POLICED_PORT, 0);
+    }
+    assert(policer_egress_burst(POLICED_PORT, pkts, 6) == 6);
+    for (uint32_t i = 0; i < 6; i++) {
+        packet_buffer_free(pkts[i]);
+    }
+
+    printf(TEST_PASSED, "test_policer_attach");
+}
+
+int main() {
+    printf("Running policer unit tests...\n");
+
+    assert(packet_init() == STATUS_SUCCESS);
+
+    test_policer_config();
+    test_policer_srtcm();
+    test_policer_trtcm();
+    test_policer_attach();
+
+    assert(policer_cleanup() == STATUS_SUCCESS);
+    assert(policer_cleanup() == STATUS_NOT_INITIALIZED);
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All policer tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,211 @@
+/**
+ * @file test_punt.c
+ * @brief Unit tests for the control-plane punt path
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "../../include/l3/punt.h"
+#include "../../include/hal/packet.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define WAIT_POLL_US 1000
+#define WAIT_POLLS 5000
+
+typedef struct {
+    uint32_t packets;               /* Packets the handler was given */
+    uint32_t last_tag;              /* Tag byte of the last one */
+    volatile int gate;              /* Handler waits while this is zero */
+    volatile int entered;           /* Set once the handler runs */
+} handler_ctx_t;
+
+static void count_handler(packet_buffer_t **packets, uint32_t count, void *arg) {
+    handler_ctx_t *ctx = arg;
+
+    __atomic_store_n(&ctx->entered, 1, __ATOMIC_RELEASE);
+    while (!__atomic_load_n(&ctx->gate, __ATOMIC_ACQUIRE)) {
+        usleep(WAIT_POLL_US);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        ctx->last_tag = packets[i]->data[14];
+    }
+    __atomic_add_fetch(&ctx->packets, count, __ATOMIC_RELEASE);
+}
+
+static packet_buffer_t *make_frame(uint8_t tag) {
+    uint8_t frame[60] = {0};
+    packet_buffer_t *pkt = packet_buffer_alloc(128);
+
+    memset(frame, 0xAA, 6);
+    memset(frame + 6, 0xBB, 6);
+    frame[12] = 0x88; frame[13] = 0xB5;
+    frame[14] = tag;
+
+    assert(pkt != NULL);
+    assert(packet_append_data(pkt, frame, sizeof(frame)) == STATUS_SUCCESS);
+    return pkt;
+}
+
+static punt_stats_t get_stats(punt_class_t cls) {
+    punt_stats_t stats;
+
+    assert(punt_get_stats(cls, &stats) == STATUS_SUCCESS);
+    return stats;
+}
+
+static void wait_handled(punt_class_t cls, uint64_t packets) {
+    for (uint32_t i = 0; i < WAIT_POLLS; i++) {
+        punt_stats_t stats = get_stats(cls);
+        if (stats.delivered + stats.unhandled >= packets) {
+            return;
+        }
+        usleep(WAIT_POLL_US);
+    }
+    assert(0 && "punt thread did not drain the queue");
+}
+
+void test_punt_config() {
+    punt_policer_t policer = { .rate = 1, .burst = 1, .queue_limit = 1 };
+
+    assert(punt_set_policer(PUNT_CLASS_OSPF, &policer) == ERROR_NOT_INITIALIZED);
+    assert(punt_init() == STATUS_SUCCESS);
+
+    assert(punt_get_default_policer(PUNT_CLASS_COUNT, &policer) == ERROR_INVALID_PARAMETER);
+    assert(punt_get_default_policer(PUNT_CLASS_OSPF, &policer) == STATUS_SUCCESS);
+    assert(policer.rate > 0 && policer.burst > 0);
+    assert(policer.queue_limit > 0 && policer.queue_limit <= PUNT_QUEUE_SIZE);
+
+    // Bursts and queues must fit their limits
+    policer.burst = 0;
+    assert(punt_set_policer(PUNT_CLASS_OSPF, &policer) == ERROR_INVALID_PARAMETER);
+    policer.burst = 1;
+    policer.queue_limit = PUNT_QUEUE_SIZE + 1;
+    assert(punt_set_policer(PUNT_CLASS_OSPF, &policer) == ERROR_INVALID_PARAMETER);
+    assert(punt_set_handler(PUNT_CLASS_COUNT, count_handler, NULL) == ERROR_INVALID_PARAMETER);
+
+    assert(punt_shutdown() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_punt_config");
+}
+
+void test_punt_policer() {
+    punt_policer_t policer = { .rate = 1, .burst = 3, .queue_limit = PUNT_QUEUE_SIZE };
+    handler_ctx_t ctx = { .gate = 1 };
+    packet_buffer_t *pkt = make_frame(0x5A);
+    uint32_t i;
+
+    assert(punt_init() == STATUS_SUCCESS);
+    assert(punt_set_policer(PUNT_CLASS_OSPF, &policer) == STATUS_SUCCESS);
+    assert(punt_set_handler(PUNT_CLASS_OSPF, count_handler, &ctx) == STATUS_SUCCESS);
+
+    // A quiet class punts its burst back to back, then is held to its rate
+    for (i = 0; i < 3; i++) {
+        assert(punt_packet(pkt, PUNT_CLASS_OSPF) == STATUS_SUCCESS);
+    }
+    assert(punt_packet(pkt, PUNT_CLASS_OSPF) == ERROR_PUNT_POLICED);
+    assert(punt_packet(pkt, PUNT_CLASS_OSPF) == ERROR_PUNT_POLICED);
+
+    // Other classes have their own policer
+    assert(punt_packet(pkt, PUNT_CLASS_BFD) == STATUS_SUCCESS);
+
+    wait_handled(PUNT_CLASS_OSPF, 3);
+    assert(__atomic_load_n(&ctx.packets, __ATOMIC_ACQUIRE) == 3);
+    assert(ctx.last_tag == 0x5A);
+    assert(get_stats(PUNT_CLASS_OSPF).punted == 3);
+    assert(get_stats(PUNT_CLASS_OSPF).policed == 2);
+
+    // The caller keeps its packet; the queue only had a reference
+    assert(pkt->data[14] == 0x5A);
+
+    // A zero rate drops the class
+    policer.rate = 0;
+    assert(punt_set_policer(PUNT_CLASS_OSPF, &policer) == STATUS_SUCCESS);
+    assert(punt_packet(pkt, PUNT_CLASS_OSPF) == ERROR_PUNT_POLICED);
+
+    assert(punt_shutdown() == STATUS_SUCCESS);
+    packet_buffer_free(pkt);
+    printf(TEST_PASSED, "test_punt_policer");
+}
+
+void test_punt_queue_limit() {
+    punt_policer_t policer = { .rate = 1000000, .burst = 1000, .queue_limit = 2 };
+    handler_ctx_t ctx = { .gate = 0 };
+    packet_buffer_t *pkt = make_frame(0x01);
+    uint32_t i;
+
+    assert(punt_init() == STATUS_SUCCESS);
+    assert(punt_set_policer(PUNT_CLASS_BFD, &policer) == STATUS_SUCCESS);
+    assert(punt_set_handler(PUNT_CLASS_BFD, count_handler, &ctx) == STATUS_SUCCESS);
+
+    // Hold the punt thread in the handler with the first packet
+    assert(punt_packet(pkt, PUNT_CLASS_BFD) == STATUS_SUCCESS);
+    for (i = 0; i < WAIT_POLLS && !__atomic_load_n(&ctx.entered, __ATOMIC_ACQUIRE); i++) {
+        usleep(WAIT_POLL_US);
+    }
+    assert(ctx.entered);
+
+    // A slow handler only fills its own queue
+    assert(punt_packet(pkt, PUNT_CLASS_BFD) == STATUS_SUCCESS);
+    assert(punt_packet(pkt, PUNT_CLASS_BFD) == STATUS_SUCCESS);
+    assert(punt_packet(pkt, PUNT_CLASS_BFD) == STATUS_RESOURCE_EXCEEDED);
+    assert(get_stats(PUNT_CLASS_BFD).depth == 2);
+    assert(get_stats(PUNT_CLASS_BFD).queue_drops == 1);
+
+    __atomic_store_n(&ctx.gate, 1, __ATOMIC_RELEASE);
+    wait_handled(PUNT_CLASS_BFD, 3);
+    assert(__atomic_load_n(&ctx.packets, __ATOMIC_ACQUIRE) == 3);
+    assert(get_stats(PUNT_CLASS_BFD).depth == 0);
+
+    assert(punt_shutdown() == STATUS_SUCCESS);
+    packet_buffer_free(pkt);
+    printf(TEST_PASSED, "test_punt_queue_limit");
+}
+
+void test_punt_unhandled() {
+    handler_ctx_t ctx = { .gate = 1 };
+    packet_buffer_t *pkt = make_frame(0x02);
+
+    assert(punt_init() == STATUS_SUCCESS);
+
+    // A class without a handler still drains, counted as unhandled
+    assert(punt_packet(pkt, PUNT_CLASS_OTHER) == STATUS_SUCCESS);
+    wait_handled(PUNT_CLASS_OTHER, 1);
+    assert(get_stats(PUNT_CLASS_OTHER).unhandled == 1);
+    assert(get_stats(PUNT_CLASS_OTHER).delivered == 0);
+
+    // Clearing a handler goes back to dropping
+    assert(punt_set_handler(PUNT_CLASS_OTHER, count_handler, &ctx) == STATUS_SUCCESS);
+    assert(punt_packet(pkt, PUNT_CLASS_OTHER) == STATUS_SUCCESS);
+    wait_handled(PUNT_CLASS_OTHER, 2);
+    assert(get_stats(PUNT_CLASS_OTHER).delivered == 1);
+    assert(punt_set_handler(PUNT_CLASS_OTHER, NULL, NULL) == STATUS_SUCCESS);
+    assert(punt_packet(pkt, PUNT_CLASS_OTHER) == STATUS_SUCCESS);
+    wait_handled(PUNT_CLASS_OTHER, 3);
+    assert(get_stats(PUNT_CLASS_OTHER).unhandled == 2);
+    assert(ctx.packets == 1);
+
+    assert(punt_shutdown() == STATUS_SUCCESS);
+    packet_buffer_free(pkt);
+    printf(TEST_PASSED, "test_punt_unhandled");
+}
+
+int main() {
+    printf("Running punt path unit tests...\n");
+
+    assert(packet_init() == STATUS_SUCCESS);
+
+    test_punt_config();
+    test_punt_policer();
+    test_punt_queue_limit();
+    test_punt_unhandled();
+
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All punt path tests completed successfully.\n");
+    return 0;
+}
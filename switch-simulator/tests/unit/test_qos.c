@@ -0,0 +1,272 @@
+/**
+ * @file test_qos.c
+ * @brief Unit tests for egress queueing and scheduling
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/hal/qos.h"
+#include "../../include/hal/packet.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define QOS_PORT 3
+
+static packet_buffer_t *make_packet(uint32_t len, uint8_t priority, uint8_t dscp) {
+    uint8_t frame[1024] = {0};
+    packet_buffer_t *pkt = packet_buffer_alloc(len);
+
+    assert(len >= 34 && len <= sizeof(frame));
+    memset(frame, 0xAA, 6);
+    memset(frame + 6, 0xBB, 6);
+    frame[12] = 0x08; frame[13] = 0x00;
+    frame[14] = 0x45;
+    frame[15] = (uint8_t)(dscp << 2);
+    frame[16] = (uint8_t)((len - 14) >> 8); frame[17] = (uint8_t)(len - 14);
+    frame[22] = 64;
+    frame[23] = 17;
+
+    assert(pkt != NULL);
+    assert(packet_append_data(pkt, frame, len) == STATUS_SUCCESS);
+    pkt->metadata.priority = priority;
+    return pkt;
+}
+
+static uint32_t queue_of(const packet_buffer_t *pkt) {
+    return pkt->metadata.priority;
+}
+
+static void drain(port_id_t port) {
+    packet_buffer_t *out[PACKET_BURST_MAX];
+    uint32_t n;
+
+    while ((n = qos_dequeue_burst(port, out, PACKET_BURST_MAX)) > 0) {
+        for (uint32_t i = 0; i < n; i++) {
+            packet_buffer_free(out[i]);
+        }
+    }
+}
+
+void test_qos_config() {
+    qos_port_config_t config;
+    packet_buffer_t *pkt = make_packet(64, 0, 0);
+    uint32_t queued;
+
+    assert(qos_init() == STATUS_SUCCESS);
+    assert(qos_get_default_config(&config) == STATUS_SUCCESS);
+    assert(config.queues[7].sched == QOS_SCHED_STRICT);
+    assert(config.queues[0].sched == QOS_SCHED_DWRR && config.queues[0].weight == 1);
+    assert(config.pcp_to_queue[5] == 5 && config.dscp_to_queue[46] == 5);
+
+    // Ports send straight to their TX ring until queueing is enabled
+    assert(!qos_port_enabled(QOS_PORT));
+    assert(qos_enqueue_burst(QOS_PORT, &pkt, 1, &queued) == STATUS_NOT_INITIALIZED);
+    assert(queued == 0);
+
+    // Bad configurations are refused
+    config.queues[0].weight = 0;
+    assert(qos_port_enable(QOS_PORT, &config) == STATUS_INVALID_PARAMETER);
+    config.queues[0].weight = 1;
+    config.queues[1].limit = QOS_QUEUE_CAPACITY + 1;
+    assert(qos_port_enable(QOS_PORT, &config) == STATUS_INVALID_PARAMETER);
+    config.queues[1].limit = QOS_QUEUE_LIMIT_DEFAULT;
+    config.pcp_to_queue[2] = QOS_QUEUES_PER_PORT;
+    assert(qos_port_enable(QOS_PORT, &config) == STATUS_INVALID_PARAMETER);
+    config.pcp_to_queue[2] = 2;
+    config.queues[2].wred = (qos_wred_t){ .enabled = true, .min_threshold = 10, .max_threshold = 10,
+                                          .max_drop_percent = 50 };
+    assert(qos_port_enable(QOS_PORT, &config) == STATUS_INVALID_PARAMETER);
+    assert(!qos_port_enabled(QOS_PORT));
+
+    assert(qos_get_default_config(&config) == STATUS_SUCCESS);
+    assert(qos_port_enable(QOS_PORT, &config) == STATUS_SUCCESS);
+    assert(qos_port_enabled(QOS_PORT));
+    assert(qos_port_disable(QOS_PORT) == STATUS_SUCCESS);
+    assert(!qos_port_enabled(QOS_PORT));
+
+    assert(qos_shutdown() == STATUS_SUCCESS);
+    packet_buffer_free(pkt);
+    printf(TEST_PASSED, "test_qos_config");
+}
+
+void test_qos_tail_drop() {
+    qos_port_config_t config;
+    packet_buffer_t *pkts[6];
+    qos_queue_stats_t stats;
+    uint32_t queued, i;
+
+    assert(qos_init() == STATUS_SUCCESS);
+    assert(qos_get_default_config(&config) == STATUS_SUCCESS);
+    config.queues[1].limit = 2;
+    assert(qos_port_enable(QOS_PORT, &config) == STATUS_SUCCESS);
+
+    // Four packets for a queue of two, interleaved with two for queue 0
+    for (i = 0; i < 6; i++) {
+        pkts[i] = make_packet(64, i % 3 == 0 ? 0 : 1, 0);
+    }
+    assert(qos_enqueue_burst(QOS_PORT, pkts, 6, &queued) == STATUS_SUCCESS);
+    assert(queued == 4);
+
+    // The queued packets come first, the caller keeps the refused tail
+    for (i = queued; i < 6; i++) {
+        assert(queue_of(pkts[i]) == 1);
+        packet_buffer_free(pkts[i]);
+    }
+    assert(qos_get_queue_stats(QOS_PORT, 1, &stats) == STATUS_SUCCESS);
+    assert(stats.enqueued == 2 && stats.tail_drops == 2);
+    assert(stats.depth == 2 && stats.max_depth == 2);
+    assert(qos_get_queue_stats(QOS_PORT, 0, &stats) == STATUS_SUCCESS);
+    assert(stats.enqueued == 2 && stats.tail_drops == 0);
+
+    drain(QOS_PORT);
+    assert(qos_get_queue_stats(QOS_PORT, 1, &stats) == STATUS_SUCCESS);
+    assert(stats.depth == 0 && stats.dequeued == 2 && stats.dequeued_bytes == 128);
+    assert(qos_clear_queue_stats(QOS_PORT, 1) == STATUS_SUCCESS);
+    assert(qos_get_queue_stats(QOS_PORT, 1, &stats) == STATUS_SUCCESS);
+    assert(stats.enqueued == 0 && stats.tail_drops == 0);
+
+    assert(qos_shutdown() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_qos_tail_drop");
+}
+
+void test_qos_strict_and_dwrr() {
+    qos_port_config_t config;
+    packet_buffer_t *pkts[40];
+    packet_buffer_t *out[16];
+    uint32_t served[QOS_QUEUES_PER_PORT] = {0};
+    uint32_t queued, n, i;
+
+    assert(qos_init() == STATUS_SUCCESS);
+    assert(qos_get_default_config(&config) == STATUS_SUCCESS);
+    config.queues[1].weight = 3;
+    assert(qos_port_enable(QOS_PORT, &config) == STATUS_SUCCESS);
+
+    // 1 KB packets: queue 0 earns two a round, queue 1 six
+    for (i = 0; i < 36; i++) {
+        pkts[i] = make_packet(1024, i % 2, 0);
+    }
+    for (i = 36; i < 40; i++) {
+        pkts[i] = make_packet(64, 7, 0);
+    }
+    assert(qos_enqueue_burst(QOS_PORT, pkts, 40, &queued) == STATUS_SUCCESS);
+    assert(queued == 40);
+
+    // The strict queue is served before anything else
+    assert(qos_dequeue_burst(QOS_PORT, out, 4) == 4);
+    for (i = 0; i < 4; i++) {
+        assert(queue_of(out[i]) == 7);
+        packet_buffer_free(out[i]);
+    }
+
+    // Two rounds split in proportion to the weights
+    n = qos_dequeue_burst(QOS_PORT, out, 16);
+    assert(n == 16);
+    for (i = 0; i < n; i++) {
+        served[queue_of(out[i])]++;
+        packet_buffer_free(out[i]);
+    }
+    assert(served[0] == 4 && served[1] == 12);
+
+    // A strict packet arriving mid-backlog jumps the DWRR queues
+    pkts[0] = make_packet(64, 7, 0);
+    assert(qos_enqueue_burst(QOS_PORT, pkts, 1, &queued) == STATUS_SUCCESS && queued == 1);
+    assert(qos_dequeue_burst(QOS_PORT, out, 1) == 1);
+    assert(queue_of(out[0]) == 7);
+    packet_buffer_free(out[0]);
+
+    drain(QOS_PORT);
+    assert(qos_shutdown() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_qos_strict_and_dwrr");
+}
+
+void test_qos_dscp_trust() {
+    qos_port_config_t config;
+    packet_buffer_t *pkts[2] = { make_packet(64, 1, 46), make_packet(64, 1, 0) };
+    packet_buffer_t *arp = packet_buffer_alloc(64);
+    uint8_t frame[60] = {0};
+    qos_queue_stats_t stats;
+    uint32_t queued;
+
+    frame[12] = 0x08; frame[13] = 0x06;
+    assert(arp != NULL);
+    assert(packet_append_data(arp, frame, sizeof(frame)) == STATUS_SUCCESS);
+    arp->metadata.priority = 6;
+
+    assert(qos_init() == STATUS_SUCCESS);
+    assert(qos_get_default_config(&config) == STATUS_SUCCESS);
+    config.trust = QOS_TRUST_DSCP;
+    assert(qos_port_enable(QOS_PORT, &config) == STATUS_SUCCESS);
+
+    // EF goes to queue 5 and best effort to 0, whatever the priority says
+    assert(qos_enqueue_burst(QOS_PORT, pkts, 2, &queued) == STATUS_SUCCESS && queued == 2);
+    assert(qos_get_queue_stats(QOS_PORT, 5, &stats) == STATUS_SUCCESS && stats.depth == 1);
+    assert(qos_get_queue_stats(QOS_PORT, 0, &stats) == STATUS_SUCCESS && stats.depth == 1);
+    assert(qos_get_queue_stats(QOS_PORT, 1, &stats) == STATUS_SUCCESS && stats.depth == 0);
+
+    // Frames without an IP header fall back to their priority
+    assert(qos_enqueue_burst(QOS_PORT, &arp, 1, &queued) == STATUS_SUCCESS && queued == 1);
+    assert(qos_get_queue_stats(QOS_PORT, 6, &stats) == STATUS_SUCCESS && stats.depth == 1);
+
+    drain(QOS_PORT);
+    assert(qos_shutdown() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_qos_dscp_trust");
+}
+
+void test_qos_wred() {
+    qos_port_config_t config;
+    packet_buffer_t *pkts[PACKET_BURST_MAX];
+    qos_queue_stats_t stats;
+    uint32_t queued, total = 0, i;
+
+    assert(qos_init() == STATUS_SUCCESS);
+    assert(qos_get_default_config(&config) == STATUS_SUCCESS);
+    config.queues[0].wred = (qos_wred_t){ .enabled = true, .min_threshold = 4, .max_threshold = 8,
+                                          .max_drop_percent = 100 };
+    assert(qos_port_enable(QOS_PORT, &config) == STATUS_SUCCESS);
+
+    // With nothing draining the queue its average passes both thresholds
+    for (uint32_t round = 0; round < QOS_QUEUE_LIMIT_DEFAULT / PACKET_BURST_MAX; round++) {
+        for (i = 0; i < PACKET_BURST_MAX; i++) {
+            pkts[i] = make_packet(64, 0, 0);
+        }
+        assert(qos_enqueue_burst(QOS_PORT, pkts, PACKET_BURST_MAX, &queued) == STATUS_SUCCESS);
+        for (i = queued; i < PACKET_BURST_MAX; i++) {
+            packet_buffer_free(pkts[i]);
+        }
+        total += queued;
+    }
+
+    // WRED refuses packets well before the tail-drop limit is reached
+    assert(qos_get_queue_stats(QOS_PORT, 0, &stats) == STATUS_SUCCESS);
+    assert(stats.wred_drops > 0 && stats.tail_drops == 0);
+    assert(stats.enqueued == total && stats.depth < QOS_QUEUE_LIMIT_DEFAULT);
+    assert(stats.avg_depth >= config.queues[0].wred.max_threshold);
+
+    // Disabling the port drops what it still holds
+    assert(qos_port_disable(QOS_PORT) == STATUS_SUCCESS);
+    assert(qos_dequeue_burst(QOS_PORT, pkts, PACKET_BURST_MAX) == 0);
+
+    assert(qos_shutdown() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_qos_wred");
+}
+
+int main() {
+    printf("Running QoS unit tests...\n");
+
+    assert(packet_init() == STATUS_SUCCESS);
+
+    test_qos_config();
+    test_qos_tail_drop();
+    test_qos_strict_and_dwrr();
+    test_qos_dscp_trust();
+    test_qos_wred();
+
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All QoS tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,210 @@
+/**
+ * @file test_ring.c
+ * @brief Unit tests for the lock-free pointer rings
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "../../include/common/ring.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define STRESS_THREADS 4
+#define STRESS_ITEMS 200000
+#define STRESS_BURST 32
+#define STRESS_RING_SIZE 256
+
+typedef struct {
+    ring_t *ring;
+    uint32_t id;
+    uint32_t *received;          /* Items taken, summed over consumers */
+    uint8_t *seen;               /* Times each item was taken */
+    uint32_t total;
+} stress_arg_t;
+
+/* Items are producer << 24 | sequence + 1, never NULL */
+static inline void *stress_item(uint32_t producer, uint32_t seq) {
+    return (void *)(uintptr_t)(((uintptr_t)producer << 24) | (seq + 1));
+}
+
+static void *stress_producer(void *arg) {
+    stress_arg_t *a = (stress_arg_t *)arg;
+    void *burst[STRESS_BURST];
+    uint32_t seed = a->id * 2654435761U + 1;
+    uint32_t sent = 0;
+
+    while (sent < STRESS_ITEMS) {
+        seed = seed * 1103515245U + 12345U;
+        uint32_t n = 1 + (seed >> 16) % STRESS_BURST;
+        if (n > STRESS_ITEMS - sent) {
+            n = STRESS_ITEMS - sent;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            burst[i] = stress_item(a->id, sent + i);
+        }
+        // A burst may go in part; the rest is offered again
+        sent += ring_enqueue_burst(a->ring, burst, n);
+    }
+    return NULL;
+}
+
+static void *stress_consumer(void *arg) {
+    stress_arg_t *a = (stress_arg_t *)arg;
+    void *burst[STRESS_BURST];
+    uint32_t last[STRESS_THREADS] = { 0 };
+    uint32_t seed = a->id * 40503U + 7;
+
+    while (__atomic_load_n(a->received, __ATOMIC_RELAXED) < a->total) {
+        seed = seed * 1103515245U + 12345U;
+        uint32_t n = ring_dequeue_burst(a->ring, burst, 1 + (seed >> 16) % STRESS_BURST);
+        for (uint32_t i = 0; i < n; i++) {
+            uintptr_t item = (uintptr_t)burst[i];
+            uint32_t producer = (uint32_t)(item >> 24);
+            uint32_t seq = (uint32_t)(item & 0xFFFFFF);
+
+            assert(producer < STRESS_THREADS && seq >= 1 && seq <= STRESS_ITEMS);
+            // One producer's items reach any one consumer in the order sent
+            assert(seq > last[producer]);
+            last[producer] = seq;
+            __atomic_fetch_add(&a->seen[producer * STRESS_ITEMS + seq - 1], 1, __ATOMIC_RELAXED);
+        }
+        if (n > 0) {
+            __atomic_fetch_add(a->received, n, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+void test_ring_create() {
+    ring_t *ring;
+
+    assert(ring_create(0, 0) == NULL);
+    assert(ring_create(100, 0) == NULL);
+
+    ring = ring_create(8, 0);
+    assert(ring != NULL);
+    assert(ring->size == 8 && ring->mask == 7);
+    assert(ring_count(ring) == 0);
+    assert(ring_free_count(ring) == 8);
+    ring_destroy(ring);
+    ring_destroy(NULL);
+
+    printf(TEST_PASSED, "test_ring_create");
+}
+
+void test_ring_burst_fill_and_drain() {
+    ring_t *ring = ring_create(8, 0);
+    void *in[10];
+    void *out[10];
+    uintptr_t i;
+
+    for (i = 0; i < 10; i++) {
+        in[i] = (void *)(i + 1);
+    }
+
+    // Only as many as fit go in
+    assert(ring_enqueue_burst(ring, in, 10) == 8);
+    assert(ring_count(ring) == 8);
+    assert(ring_free_count(ring) == 0);
+    assert(!ring_enqueue(ring, in[8]));
+
+    // First in, first out, in bursts smaller than what is queued
+    assert(ring_dequeue_burst(ring, out, 3) == 3);
+    assert(out[0] == in[0] && out[1] == in[1] && out[2] == in[2]);
+    assert(ring_enqueue_burst(ring, &in[8], 2) == 2);
+    assert(ring_dequeue_burst(ring, out, 10) == 7);
+    for (i = 0; i < 7; i++) {
+        assert(out[i] == in[3 + i]);
+    }
+    assert(ring_dequeue_burst(ring, out, 10) == 0);
+    assert(!ring_dequeue(ring, &out[0]));
+
+    ring_destroy(ring);
+    printf(TEST_PASSED, "test_ring_burst_fill_and_drain");
+}
+
+void test_ring_counter_wrap() {
+    ring_t *ring = ring_create(4, 0);
+    void *out[4];
+    uintptr_t i;
+
+    // Counters are free-running; start them just short of wrapping
+    ring->prod.head = ring->prod.tail = UINT32_MAX - 1;
+    ring->cons.head = ring->cons.tail = UINT32_MAX - 1;
+
+    for (uintptr_t round = 0; round < 4; round++) {
+        for (i = 0; i < 3; i++) {
+            assert(ring_enqueue(ring, (void *)(round * 16 + i + 1)));
+        }
+        assert(ring_count(ring) == 3);
+        assert(ring_dequeue_burst(ring, out, 4) == 3);
+        for (i = 0; i < 3; i++) {
+            assert(out[i] == (void *)(round * 16 + i + 1));
+        }
+    }
+    assert(ring_count(ring) == 0);
+
+    ring_destroy(ring);
+    printf(TEST_PASSED, "test_ring_counter_wrap");
+}
+
+static void ring_stress(uint32_t flags, uint32_t producers, uint32_t consumers, const char *name) {
+    ring_t *ring = ring_create(STRESS_RING_SIZE, flags);
+    pthread_t threads[2 * STRESS_THREADS];
+    stress_arg_t args[2 * STRESS_THREADS];
+    uint8_t *seen = calloc((size_t)STRESS_THREADS * STRESS_ITEMS, 1);
+    uint32_t received = 0;
+    uint32_t total = producers * STRESS_ITEMS;
+    uint32_t i;
+
+    assert(ring && seen);
+    for (i = 0; i < producers + consumers; i++) {
+        args[i].ring = ring;
+        args[i].id = (i < producers) ? i : i - producers;
+        args[i].received = &received;
+        args[i].seen = seen;
+        args[i].total = total;
+        assert(pthread_create(&threads[i], NULL, (i < producers) ? stress_producer : stress_consumer,
+                              &args[i]) == 0);
+    }
+    for (i = 0; i < producers + consumers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Every item came out exactly once
+    assert(received == total);
+    for (i = 0; i < total; i++) {
+        assert(seen[i] == 1);
+    }
+    assert(ring_count(ring) == 0);
+
+    free(seen);
+    ring_destroy(ring);
+    printf(TEST_PASSED, name);
+}
+
+void test_ring_spsc_stress() {
+    ring_stress(RING_F_SP_ENQ | RING_F_SC_DEQ, 1, 1, "test_ring_spsc_stress");
+}
+
+void test_ring_mpmc_burst_stress() {
+    ring_stress(0, STRESS_THREADS, STRESS_THREADS, "test_ring_mpmc_burst_stress");
+}
+
+int main() {
+    printf("Running Ring unit tests...\n");
+
+    test_ring_create();
+    test_ring_burst_fill_and_drain();
+    test_ring_counter_wrap();
+    test_ring_spsc_stress();
+    test_ring_mpmc_burst_stress();
+
+    printf("All Ring tests passed!\n");
+    return 0;
+}
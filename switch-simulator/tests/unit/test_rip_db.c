@@ -0,0 +1,227 @@
+/**
+ * @file test_rip_db.c
+ * @brief Unit tests for the RIP route database
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/l3/rip_db.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define MASK_24 0xFFFFFF00
+#define PEER_A 0x0A000001
+#define PEER_B 0x0A000002
+#define IF_A 1
+#define IF_B 2
+#define IF_C 3
+#define MANY_ROUTES 3000
+
+static rip_db_change_t update(rip_db_t *db, uint32_t destination, uint32_t next_hop, uint32_t metric,
+                              uint32_t ifindex, uint32_t now) {
+    rip_db_rte_t rte = {destination, MASK_24, next_hop, metric};
+    rip_db_change_t change;
+
+    assert(rip_db_update(db, &rte, ifindex, now, &change) == STATUS_SUCCESS);
+    return change;
+}
+
+typedef struct {
+    uint32_t timeouts;
+    uint32_t deletes;
+} expire_ctx_t;
+
+static void on_expire(const rip_db_route_t *route, rip_db_event_t event, void *arg) {
+    expire_ctx_t *ctx = arg;
+
+    if (event == RIP_DB_EVENT_TIMEOUT) {
+        assert(!route->valid && route->metric == RIP_DB_INFINITY);
+        ctx->timeouts++;
+    } else {
+        ctx->deletes++;
+    }
+}
+
+typedef struct {
+    uint32_t responses;
+    uint32_t rtes;
+    uint32_t unreachable;
+    uint32_t fail_after;            /* Fail the send after this many Responses, 0 never */
+} send_ctx_t;
+
+static status_t on_send(uint32_t ifindex, const rip_db_rte_t *rtes, uint32_t count, void *arg) {
+    send_ctx_t *ctx = arg;
+
+    (void)ifindex;
+    assert(count >= 1 && count <= RIP_DB_MAX_RTES);
+    if (ctx->fail_after && ctx->responses == ctx->fail_after) {
+        return STATUS_FAILURE;
+    }
+    ctx->responses++;
+    ctx->rtes += count;
+    for (uint32_t i = 0; i < count; i++) {
+        if (rtes[i].metric == RIP_DB_INFINITY) {
+            ctx->unreachable++;
+        }
+    }
+    return STATUS_SUCCESS;
+}
+
+void test_rip_db_update() {
+    rip_db_t *db = rip_db_create(0, 1);
+    const rip_db_route_t *route;
+    rip_db_rte_t bad = {0x0A010001, MASK_24, PEER_A, 1};
+
+    assert(db != NULL);
+    assert(rip_db_update(db, &bad, IF_A, 0, NULL) == STATUS_INVALID_PARAMETER);
+
+    // Unknown unreachable routes are not kept
+    assert(update(db, 0x0A010000, PEER_A, RIP_DB_INFINITY, IF_A, 0) == RIP_DB_UNCHANGED);
+    assert(rip_db_count(db) == 0);
+
+    assert(update(db, 0x0A010000, PEER_A, 3, IF_A, 0) == RIP_DB_ADDED);
+    route = rip_db_lookup(db, 0x0A010000, MASK_24);
+    assert(route != NULL && route->valid && route->metric == 3 && route->changed);
+
+    // Another router needs a better metric, the current one is believed
+    assert(update(db, 0x0A010000, PEER_B, 3, IF_B, 1) == RIP_DB_UNCHANGED);
+    assert(update(db, 0x0A010000, PEER_B, 2, IF_B, 1) == RIP_DB_CHANGED);
+    assert(route->next_hop == PEER_B && route->interface_index == IF_B);
+    assert(update(db, 0x0A010000, PEER_B, 5, IF_B, 2) == RIP_DB_CHANGED);
+    assert(route->metric == 5);
+
+    // Metrics are capped at infinity, which withdraws the route
+    assert(update(db, 0x0A010000, PEER_B, 20, IF_B, 3) == RIP_DB_WITHDRAWN);
+    assert(!route->valid && route->metric == RIP_DB_INFINITY);
+    assert(update(db, 0x0A010000, PEER_B, RIP_DB_INFINITY, IF_B, 4) == RIP_DB_UNCHANGED);
+
+    // Any reachable metric revives it
+    assert(update(db, 0x0A010000, PEER_A, 4, IF_A, 5) == RIP_DB_ADDED);
+    assert(route->valid && route->next_hop == PEER_A);
+    assert(rip_db_count(db) == 1);
+
+    rip_db_destroy(db);
+    printf(TEST_PASSED, "test_rip_db_update");
+}
+
+void test_rip_db_expire() {
+    rip_db_t *db = rip_db_create(100, 1);
+    expire_ctx_t ctx = {0};
+
+    update(db, 0x0A010000, PEER_A, 1, IF_A, 100);
+    update(db, 0x0A020000, PEER_A, 1, IF_A, 100);
+    assert(rip_db_expire(db, 100 + RIP_DB_TIMEOUT - 1, on_expire, &ctx) == 0);
+
+    // A refresh from the same router restarts the timeout
+    update(db, 0x0A020000, PEER_A, 1, IF_A, 250);
+    assert(rip_db_expire(db, 100 + RIP_DB_TIMEOUT, on_expire, &ctx) == 1);
+    assert(ctx.timeouts == 1);
+    assert(!rip_db_lookup(db, 0x0A010000, MASK_24)->valid);
+    assert(rip_db_lookup(db, 0x0A020000, MASK_24)->valid);
+
+    // Garbage collection ends the timed-out route
+    assert(rip_db_expire(db, 100 + RIP_DB_TIMEOUT + RIP_DB_GARBAGE_TIME, on_expire, &ctx) == 1);
+    assert(ctx.deletes == 1);
+    assert(rip_db_lookup(db, 0x0A010000, MASK_24) == NULL);
+    assert(rip_db_count(db) == 1);
+
+    // A long stall times out and deletes in one catch-up
+    assert(rip_db_expire(db, 10000, on_expire, &ctx) == 1);
+    assert(ctx.timeouts == 2);
+    assert(rip_db_expire(db, 10000 + RIP_DB_GARBAGE_TIME, on_expire, &ctx) == 1);
+    assert(ctx.deletes == 2 && rip_db_count(db) == 0);
+
+    rip_db_destroy(db);
+    printf(TEST_PASSED, "test_rip_db_expire");
+}
+
+void test_rip_db_triggered() {
+    rip_db_t *db = rip_db_create(0, 7);
+    send_ctx_t sent = {0};
+
+    update(db, 0x0A010000, PEER_A, 1, IF_A, 0);
+    update(db, 0x0A020000, PEER_B, 1, IF_B, 0);
+    assert(rip_db_trigger_due(db, 0));
+
+    // Split horizon leaves out what was learned on the interface
+    assert(rip_db_send_update(db, IF_A, true, on_send, &sent) == 1);
+    assert(sent.rtes == 1);
+    memset(&sent, 0, sizeof(sent));
+    assert(rip_db_send_update(db, IF_C, true, on_send, &sent) == 1);
+    assert(sent.rtes == 2);
+
+    // Changes during the hold-off wait for it and leave together
+    rip_db_updates_sent(db, 10);
+    assert(!rip_db_trigger_due(db, 10));
+    update(db, 0x0A030000, PEER_A, 2, IF_A, 10);
+    update(db, 0x0A010000, PEER_A, RIP_DB_INFINITY, IF_A, 11);
+    assert(!rip_db_trigger_due(db, 10 + RIP_DB_TRIGGER_MIN - 1));
+    assert(rip_db_trigger_due(db, 10 + RIP_DB_TRIGGER_MAX));
+    memset(&sent, 0, sizeof(sent));
+    assert(rip_db_send_update(db, IF_C, true, on_send, &sent) == 1);
+    assert(sent.rtes == 2 && sent.unreachable == 1);
+
+    // A full update still carries the withdrawn route
+    rip_db_updates_sent(db, 20);
+    assert(!rip_db_trigger_due(db, 100));
+    memset(&sent, 0, sizeof(sent));
+    assert(rip_db_send_update(db, IF_C, false, on_send, &sent) == 1);
+    assert(sent.rtes == 3 && sent.unreachable == 1);
+
+    // A route deleted while still changed leaves the update
+    update(db, 0x0A020000, PEER_B, RIP_DB_INFINITY, IF_B, 30);
+    assert(rip_db_expire(db, 30 + RIP_DB_GARBAGE_TIME, NULL, NULL) >= 1);
+    assert(rip_db_lookup(db, 0x0A020000, MASK_24) == NULL);
+    memset(&sent, 0, sizeof(sent));
+    rip_db_send_update(db, IF_C, true, on_send, &sent);
+    assert(sent.rtes == 0);
+
+    rip_db_destroy(db);
+    printf(TEST_PASSED, "test_rip_db_triggered");
+}
+
+void test_rip_db_many() {
+    rip_db_t *db = rip_db_create(0, 3);
+    send_ctx_t sent = {0};
+    uint32_t i;
+
+    for (i = 0; i < MANY_ROUTES; i++) {
+        assert(update(db, 0x0B000000 + (i << 8), PEER_A, 1 + i % 15, IF_A, 0) == RIP_DB_ADDED);
+    }
+    assert(rip_db_count(db) == MANY_ROUTES);
+    for (i = 0; i < MANY_ROUTES; i++) {
+        assert(rip_db_lookup(db, 0x0B000000 + (i << 8), MASK_24) != NULL);
+    }
+
+    // Full Responses of 25 RTEs, and a failed send ends the burst
+    assert(rip_db_send_update(db, IF_B, false, on_send, &sent) ==
+           (MANY_ROUTES + RIP_DB_MAX_RTES - 1) / RIP_DB_MAX_RTES);
+    assert(sent.rtes == MANY_ROUTES);
+    memset(&sent, 0, sizeof(sent));
+    sent.fail_after = 3;
+    assert(rip_db_send_update(db, IF_B, true, on_send, &sent) == 3);
+
+    // Every one of them times out at once
+    assert(rip_db_expire(db, RIP_DB_TIMEOUT, NULL, NULL) == MANY_ROUTES);
+    assert(rip_db_expire(db, RIP_DB_TIMEOUT + RIP_DB_GARBAGE_TIME, NULL, NULL) == MANY_ROUTES);
+    assert(rip_db_count(db) == 0);
+
+    rip_db_destroy(db);
+    printf(TEST_PASSED, "test_rip_db_many");
+}
+
+int main() {
+    printf("Running RIP database unit tests...\n");
+
+    test_rip_db_update();
+    test_rip_db_expire();
+    test_rip_db_triggered();
+    test_rip_db_many();
+
+    printf("All RIP database tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,341 @@
+/**
+ * @file test_route_loader.c
+ * @brief Unit tests for bulk route loads from MRT dumps and route images
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "../../include/l3/route_loader.h"
+#include "../../include/l3/routing_table.h"
+#include "../../include/hal/hw_resources.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define MRT_TYPE_TABLE_DUMP_V2 13
+#define MRT_PEER_INDEX_TABLE 1
+#define MRT_RIB_IPV4_UNICAST 2
+#define MRT_RIB_IPV6_UNICAST 4
+#define MANY_ROUTES 40000           /* Enough for more than one parser thread */
+
+static routing_table_t g_table;
+
+/* File contents being built */
+typedef struct {
+    uint8_t data[1024];
+    size_t len;
+    size_t record;                  /* Start of the open MRT record */
+} file_buf_t;
+
+static void put8(file_buf_t *buf, uint8_t v) {
+    assert(buf->len < sizeof(buf->data));
+    buf->data[buf->len++] = v;
+}
+
+static void put16(file_buf_t *buf, uint16_t v) {
+    put8(buf, (uint8_t)(v >> 8));
+    put8(buf, (uint8_t)v);
+}
+
+static void put32(file_buf_t *buf, uint32_t v) {
+    put16(buf, (uint16_t)(v >> 16));
+    put16(buf, (uint16_t)v);
+}
+
+static void put_bytes(file_buf_t *buf, const void *bytes, size_t len) {
+    assert(buf->len + len <= sizeof(buf->data));
+    memcpy(buf->data + buf->len, bytes, len);
+    buf->len += len;
+}
+
+static void record_begin(file_buf_t *buf, uint16_t subtype) {
+    buf->record = buf->len;
+    put32(buf, 0);
+    put16(buf, MRT_TYPE_TABLE_DUMP_V2);
+    put16(buf, subtype);
+    put32(buf, 0);
+}
+
+static void record_end(file_buf_t *buf) {
+    uint32_t length = (uint32_t)(buf->len - buf->record - 12);
+
+    buf->data[buf->record + 8] = (uint8_t)(length >> 24);
+    buf->data[buf->record + 9] = (uint8_t)(length >> 16);
+    buf->data[buf->record + 10] = (uint8_t)(length >> 8);
+    buf->data[buf->record + 11] = (uint8_t)length;
+}
+
+/* RIB entry with a NEXT_HOP and, if med is non-zero, a MULTI_EXIT_DISC */
+static void rib_entry_v4(file_buf_t *buf, uint16_t peer, const char *next_hop, uint32_t med) {
+    struct in_addr nh;
+
+    assert(inet_pton(AF_INET, next_hop, &nh) == 1);
+    put16(buf, peer);
+    put32(buf, 0);
+    put16(buf, med ? 14 : 7);
+    put8(buf, 0x40);
+    put8(buf, 3);
+    put8(buf, 4);
+    put_bytes(buf, &nh, 4);
+    if (med) {
+        put8(buf, 0x80);
+        put8(buf, 4);
+        put8(buf, 4);
+        put32(buf, med);
+    }
+}
+
+/* RIB entry with the abbreviated MP_REACH_NLRI of RFC 6396 4.3.4 */
+static void rib_entry_v6(file_buf_t *buf, uint16_t peer, const char *next_hop) {
+    struct in6_addr nh;
+
+    assert(inet_pton(AF_INET6, next_hop, &nh) == 1);
+    put16(buf, peer);
+    put32(buf, 0);
+    put16(buf, 20);
+    put8(buf, 0x80);
+    put8(buf, 14);
+    put8(buf, 17);
+    put8(buf, 16);
+    put_bytes(buf, &nh, 16);
+}
+
+static void write_file(const char *path, const void *data, size_t len) {
+    FILE *file = fopen(path, "wb");
+
+    assert(file != NULL);
+    assert(len == 0 || fwrite(data, len, 1, file) == 1);
+    assert(fclose(file) == 0);
+}
+
+static ip_addr_t v4(const char *text) {
+    ip_addr_t addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.type = IP_TYPE_V4;
+    assert(inet_pton(AF_INET, text, &addr.addr.v4) == 1);
+    return addr;
+}
+
+static ip_addr_t v6(const char *text) {
+    ip_addr_t addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.type = IP_TYPE_V6;
+    assert(inet_pton(AF_INET6, text, addr.addr.v6.addr) == 1);
+    return addr;
+}
+
+static uint32_t route_count(void) {
+    routing_table_stats_t stats;
+
+    assert(routing_table_get_stats(&stats) == STATUS_SUCCESS);
+    return stats.total_routes;
+}
+
+/*
+ * A small TABLE_DUMP_V2 file: a peer index table, 10.1.0.0/16 seen from
+ * peers 0 and 1, a prefix longer than 32 bits, 2001:db8::/32 from peer 0
+ * and three bytes of a record that was cut off.
+ */
+static void make_mrt(const char *path) {
+    file_buf_t buf = {0};
+    struct in6_addr prefix6;
+
+    record_begin(&buf, MRT_PEER_INDEX_TABLE);
+    put32(&buf, 0x01010101);
+    put16(&buf, 0);
+    put16(&buf, 0);
+    record_end(&buf);
+
+    record_begin(&buf, MRT_RIB_IPV4_UNICAST);
+    put32(&buf, 1);
+    put8(&buf, 16);
+    put8(&buf, 10);
+    put8(&buf, 1);
+    put16(&buf, 2);
+    rib_entry_v4(&buf, 0, "192.0.2.1", 5);
+    rib_entry_v4(&buf, 1, "192.0.2.2", 0);
+    record_end(&buf);
+
+    record_begin(&buf, MRT_RIB_IPV4_UNICAST);
+    put32(&buf, 2);
+    put8(&buf, 40);
+    put32(&buf, 0);
+    put16(&buf, 0);
+    record_end(&buf);
+
+    assert(inet_pton(AF_INET6, "2001:db8::", &prefix6) == 1);
+    record_begin(&buf, MRT_RIB_IPV6_UNICAST);
+    put32(&buf, 3);
+    put8(&buf, 32);
+    put_bytes(&buf, &prefix6, 4);
+    put16(&buf, 1);
+    rib_entry_v6(&buf, 0, "2001:db8:ffff::1");
+    record_end(&buf);
+
+    put16(&buf, 0);
+    put8(&buf, 0);
+    write_file(path, buf.data, buf.len);
+}
+
+void test_route_loader_mrt() {
+    char path[] = "/tmp/test_route_loader_XXXXXX";
+    route_loader_options_t options;
+    route_loader_stats_t stats;
+    route_entry_t route;
+    ip_addr_t addr;
+    int fd = mkstemp(path);
+
+    assert(fd >= 0);
+    close(fd);
+    make_mrt(path);
+
+    route_loader_get_default_options(&options);
+    assert(options.format == ROUTE_LOADER_FORMAT_AUTO && options.peer_index == ROUTE_LOADER_ANY_PEER);
+    options.interface_index = 3;
+    assert(route_loader_load(path, &options, &stats) == STATUS_SUCCESS);
+
+    // The index table is skipped, the bad prefix and the cut record counted
+    assert(stats.records == 4 && stats.threads == 1);
+    assert(stats.routes_parsed == 2 && stats.routes_added == 2);
+    assert(stats.skipped == 1 && stats.malformed == 2);
+
+    // The first path of a prefix is taken, MED as the metric
+    addr = v4("10.1.2.3");
+    assert(routing_lookup(&addr, IP_TYPE_V4, &route) == STATUS_SUCCESS);
+    addr = v4("192.0.2.1");
+    assert(route.route.ipv4.gateway == addr.addr.v4);
+    assert(route.metric == 5 && route.interface_index == 3);
+
+    addr = v6("2001:db8:1::1");
+    assert(routing_lookup(&addr, IP_TYPE_V6, &route) == STATUS_SUCCESS);
+    addr = v6("2001:db8:ffff::1");
+    assert(memcmp(&route.route.ipv6.next_hop, addr.addr.v6.addr, 16) == 0);
+
+    // Only peer 1's paths: the IPv6 prefix has none
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    options.peer_index = 1;
+    assert(route_loader_load(path, &options, &stats) == STATUS_SUCCESS);
+    assert(stats.routes_parsed == 1 && stats.skipped == 2);
+    addr = v4("10.1.2.3");
+    assert(routing_lookup(&addr, IP_TYPE_V4, &route) == STATUS_SUCCESS);
+    addr = v4("192.0.2.2");
+    assert(route.route.ipv4.gateway == addr.addr.v4 && route.metric == 0);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    unlink(path);
+    printf(TEST_PASSED, "test_route_loader_mrt");
+}
+
+void test_route_loader_image() {
+    char path[] = "/tmp/test_route_loader_XXXXXX";
+    routing_route_t *routes = calloc(MANY_ROUTES, sizeof(*routes));
+    route_loader_options_t options;
+    route_loader_stats_t stats;
+    route_entry_t route;
+    ip_addr_t addr;
+    uint32_t added, dumped;
+    int fd = mkstemp(path);
+
+    assert(fd >= 0 && routes != NULL);
+    close(fd);
+
+    // 10.0.0.0/24 through 10.156.63.0/24
+    for (uint32_t i = 0; i < MANY_ROUTES; i++) {
+        routes[i].type = IP_TYPE_V4;
+        routes[i].prefix.type = IP_TYPE_V4;
+        routes[i].prefix.addr.v4 = htonl(0x0A000000 + (i << 8));
+        routes[i].prefix_len = 24;
+        routes[i].next_hop.type = IP_TYPE_V4;
+        routes[i].next_hop.addr.v4 = htonl(0xC0000200 + (i % 250) + 1);
+        routes[i].interface_index = (uint16_t)(i % 8);
+        routes[i].metric = (uint16_t)(i % 100);
+        routes[i].source = ROUTE_TYPE_STATIC;
+    }
+    assert(routing_table_add_routes(routes, MANY_ROUTES, &added) == STATUS_SUCCESS);
+    assert(added == MANY_ROUTES);
+
+    assert(route_loader_dump(path, &dumped) == STATUS_SUCCESS);
+    assert(dumped == MANY_ROUTES);
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    assert(route_count() == 0);
+
+    // Fixed-size records split evenly between the parser threads
+    route_loader_get_default_options(&options);
+    options.threads = 4;
+    assert(route_loader_load(path, &options, &stats) == STATUS_SUCCESS);
+    assert(stats.records == MANY_ROUTES && stats.threads == MANY_ROUTES / 16384);
+    assert(stats.routes_parsed == MANY_ROUTES && stats.routes_added == MANY_ROUTES);
+    assert(stats.malformed == 0 && route_count() == MANY_ROUTES);
+
+    addr = v4("10.100.0.9");
+    assert(routing_lookup(&addr, IP_TYPE_V4, &route) == STATUS_SUCCESS);
+    assert(route.route.ipv4.gateway == routes[0x6400].next_hop.addr.v4);
+    assert(route.metric == routes[0x6400].metric && route.interface_index == routes[0x6400].interface_index);
+
+    // Loading it again adds nothing new
+    assert(route_loader_load(path, &options, &stats) == STATUS_SUCCESS);
+    assert(stats.routes_parsed == MANY_ROUTES && stats.routes_added == 0);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    unlink(path);
+    free(routes);
+    printf(TEST_PASSED, "test_route_loader_image");
+}
+
+void test_route_loader_errors() {
+    char path[] = "/tmp/test_route_loader_XXXXXX";
+    uint8_t header[ROUTE_LOADER_IMAGE_HEADER_LEN] = { 'S', 'W', 'R', 'T', 0, 9, 0, ROUTE_LOADER_IMAGE_RECORD_LEN };
+    route_loader_options_t options;
+    int fd = mkstemp(path);
+
+    assert(fd >= 0);
+    close(fd);
+
+    assert(route_loader_load(NULL, NULL, NULL) == STATUS_INVALID_PARAMETER);
+    assert(route_loader_load("/nonexistent/routes.mrt", NULL, NULL) == STATUS_NOT_FOUND);
+    assert(route_loader_dump("/nonexistent/routes.img", NULL) == STATUS_FAILURE);
+
+    // An empty file has nothing to detect
+    write_file(path, NULL, 0);
+    assert(route_loader_load(path, NULL, NULL) == STATUS_INVALID_PARAMETER);
+
+    // An image of another version is refused
+    write_file(path, header, sizeof(header));
+    assert(route_loader_load(path, NULL, NULL) == STATUS_INVALID_PARAMETER);
+
+    // So is anything forced to load as an image without the magic
+    header[0] = 'X';
+    header[5] = ROUTE_LOADER_IMAGE_VERSION;
+    write_file(path, header, sizeof(header));
+    route_loader_get_default_options(&options);
+    options.format = ROUTE_LOADER_FORMAT_IMAGE;
+    assert(route_loader_load(path, &options, NULL) == STATUS_INVALID_PARAMETER);
+    assert(route_count() == 0);
+
+    unlink(path);
+    printf(TEST_PASSED, "test_route_loader_errors");
+}
+
+int main() {
+    printf("Running route loader unit tests...\n");
+
+    // Routes programmed into the hardware reserve route table entries
+    assert(hw_resources_init() == STATUS_SUCCESS);
+    assert(routing_table_init(&g_table) == STATUS_SUCCESS);
+
+    test_route_loader_mrt();
+    test_route_loader_image();
+    test_route_loader_errors();
+
+    assert(routing_table_cleanup() == STATUS_SUCCESS);
+
+    printf("All route loader tests completed successfully.\n");
+    return 0;
+}
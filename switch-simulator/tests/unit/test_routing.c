@@ -7,151 +7,975 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <arpa/inet.h>
 #include "../../include/l3/routing_table.h"
 #include "../../include/l3/ip.h"
+#include "../../include/hal/hw_resources.h"
 #include "../../include/common/error_codes.h"
+#include "../../include/common/config.h"
+#include "../../include/common/event_feed.h"
+#include "../../include/common/trace.h"
+#include "../../include/common/mem_account.h"
 
 #define TEST_PASSED "[ PASSED ] %s\n"
 #define TEST_FAILED "[ FAILED ] %s: %s\n"
 
+#define MANY_ROUTES 5000
+
+static routing_table_t g_table;
+
+static ip_addr_t v4(const char *text) {
+    ip_addr_t addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.type = IP_TYPE_V4;
+    assert(inet_pton(AF_INET, text, &addr.addr.v4) == 1);
+    return addr;
+}
+
+static ip_addr_t v6(const char *text) {
+    ip_addr_t addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.type = IP_TYPE_V6;
+    assert(inet_pton(AF_INET6, text, addr.addr.v6.addr) == 1);
+    return addr;
+}
+
+static route_entry_t static_route(const char *dest, const char *mask, const char *gw, uint16_t iface) {
+    route_entry_t route;
+    ip_addr_t addr;
+
+    memset(&route, 0, sizeof(route));
+    addr = v4(dest);
+    route.route.ipv4.destination = addr.addr.v4;
+    addr = v4(mask);
+    route.route.ipv4.netmask = addr.addr.v4;
+    addr = v4(gw);
+    route.route.ipv4.gateway = addr.addr.v4;
+    route.interface_index = iface;
+    route.type = ROUTE_TYPE_STATIC;
+    route.metric = 1;
+    return route;
+}
+
+static uint32_t route_count(void) {
+    routing_table_stats_t stats;
+
+    assert(routing_table_get_stats(&stats) == STATUS_SUCCESS);
+    return stats.total_routes;
+}
+
+static void count_route(const routing_route_t *route, void *ctx) {
+    (void)route;
+    (*(uint32_t *)ctx)++;
+}
+
 void test_route_table_init() {
-    route_table_t table;
-    uint32_t result = route_table_init(&table, 1024);
-    assert(result == SUCCESS);
-    assert(table.size == 0);
-    assert(table.capacity == 1024);
-    
-    route_table_destroy(&table);
+    routing_table_t table;
+
+    assert(routing_table_init(NULL) == STATUS_INVALID_PARAMETER);
+    assert(routing_table_init(&g_table) == STATUS_SUCCESS);
+    assert(routing_table_init(&table) == STATUS_ALREADY_INITIALIZED);
+    assert(routing_table_get_instance() != NULL);
+    assert(route_count() == 0);
+
     printf(TEST_PASSED, "test_route_table_init");
 }
 
 void test_route_add() {
-    route_table_t table;
-    ip_addr_t dest_network = {192, 168, 1, 0};
-    ip_addr_t subnet_mask = {255, 255, 255, 0};
-    ip_addr_t next_hop = {192, 168, 2, 1};
-    uint32_t outgoing_interface = 2;
-    
-    route_table_init(&table, 1024);
-    
+    route_entry_t route = static_route("192.168.1.0", "255.255.255.0", "192.168.2.1", 2);
+
     // Add new route
-    uint32_t result = route_table_add(&table, &dest_network, &subnet_mask, &next_hop, outgoing_interface, ROUTE_STATIC);
-    assert(result == SUCCESS);
-    assert(table.size == 1);
-    
+    assert(routing_table_add_route(&g_table, &route) == STATUS_SUCCESS);
+    assert(route_count() == 1);
+
     // Add duplicate route
-    result = route_table_add(&table, &dest_network, &subnet_mask, &next_hop, outgoing_interface, ROUTE_STATIC);
-    assert(result == ROUTE_EXISTS);
-    assert(table.size == 1);
-    
-    route_table_destroy(&table);
+    assert(routing_table_add_route(&g_table, &route) == STATUS_ALREADY_EXISTS);
+    assert(route_count() == 1);
+
+    // Non-contiguous netmask
+    route = static_route("10.0.0.0", "255.0.255.0", "192.168.2.1", 2);
+    assert(routing_table_add_route(&g_table, &route) == STATUS_INVALID_PARAMETER);
+    assert(route_count() == 1);
+
     printf(TEST_PASSED, "test_route_add");
 }
 
 void test_route_lookup() {
-    route_table_t table;
-    ip_addr_t dest_network = {192, 168, 1, 0};
-    ip_addr_t subnet_mask = {255, 255, 255, 0};
-    ip_addr_t next_hop = {192, 168, 2, 1};
-    uint32_t outgoing_interface = 2;
-    
-    ip_addr_t dest_ip = {192, 168, 1, 100}; // IP in the destination network
+    ip_addr_t dest_ip = v4("192.168.1.100");
+    ip_addr_t invalid_ip = v4("10.0.0.1");
+    ip_addr_t next_hop = v4("192.168.2.1");
     route_entry_t route;
-    
-    route_table_init(&table, 1024);
-    route_table_add(&table, &dest_network, &subnet_mask, &next_hop, outgoing_interface, ROUTE_STATIC);
-    
+
     // Lookup existing route
-    uint32_t result = route_table_lookup(&table, &dest_ip, &route);
-    assert(result == SUCCESS);
-    assert(route.outgoing_interface == outgoing_interface);
-    assert(ip_addr_compare(&route.next_hop, &next_hop) == 0);
-    
+    assert(routing_table_lookup(&g_table, &dest_ip, IP_TYPE_V4, &route) == STATUS_SUCCESS);
+    assert(!route.is_ipv6);
+    assert(route.interface_index == 2);
+    assert(route.egress_port == 2);
+    assert(route.route.ipv4.gateway == next_hop.addr.v4);
+    assert(route.route.ipv4.netmask == htonl(0xFFFFFF00));
+    assert(route.type == ROUTE_TYPE_STATIC);
+    assert(route.admin_distance == ADMIN_DISTANCE_STATIC);
+
     // Lookup non-existing route
-    ip_addr_t invalid_ip = {10, 0, 0, 1};
-    result = route_table_lookup(&table, &invalid_ip, &route);
-    assert(result == ROUTE_NOT_FOUND);
-    
-    route_table_destroy(&table);
+    assert(routing_table_lookup(&g_table, &invalid_ip, IP_TYPE_V4, &route) == STATUS_NOT_FOUND);
+
     printf(TEST_PASSED, "test_route_lookup");
 }
 
 void test_route_delete() {
-    route_table_t table;
-    ip_addr_t dest_network = {192, 168, 1, 0};
-    ip_addr_t subnet_mask = {255, 255, 255, 0};
-    ip_addr_t next_hop = {192, 168, 2, 1};
-    uint32_t outgoing_interface = 2;
-    
-    route_table_init(&table, 1024);
-    route_table_add(&table, &dest_network, &subnet_mask, &next_hop, outgoing_interface, ROUTE_STATIC);
-    
+    ip_addr_t prefix = v4("192.168.1.0");
+    ip_addr_t dest_ip = v4("192.168.1.100");
+    route_entry_t route;
+
     // Delete existing route
-    uint32_t result = route_table_delete(&table, &dest_network, &subnet_mask);
-    assert(result == SUCCESS);
-    assert(table.size == 0);
-    
+    assert(routing_remove_route_source(&prefix, 24, IP_TYPE_V4, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(route_count() == 0);
+    assert(routing_table_lookup(&g_table, &dest_ip, IP_TYPE_V4, &route) == STATUS_NOT_FOUND);
+
     // Delete non-existing route
-    result = route_table_delete(&table, &dest_network, &subnet_mask);
-    assert(result == ROUTE_NOT_FOUND);
-    
-    route_table_destroy(&table);
+    assert(routing_remove_route_source(&prefix, 24, IP_TYPE_V4, ROUTE_TYPE_STATIC) == STATUS_NOT_FOUND);
+
     printf(TEST_PASSED, "test_route_delete");
 }
 
 void test_longest_prefix_match() {
-    route_table_t table;
     route_entry_t route;
-    
-    // Setup several routes with different prefix lengths
-    ip_addr_t network1 = {192, 168, 0, 0};
-    ip_addr_t mask1 = {255, 255, 0, 0};      // /16
-    ip_addr_t nexthop1 = {10, 0, 0, 1};
-    
-    ip_addr_t network2 = {192, 168, 1, 0};
-    ip_addr_t mask2 = {255, 255, 255, 0};    // /24
-    ip_addr_t nexthop2 = {10, 0, 0, 2};
-    
-    ip_addr_t network3 = {192, 168, 1, 128};
-    ip_addr_t mask3 = {255, 255, 255, 128};  // /25
-    ip_addr_t nexthop3 = {10, 0, 0, 3};
-    
-    route_table_init(&table, 1024);
-    route_table_add(&table, &network1, &mask1, &nexthop1, 1, ROUTE_STATIC);
-    route_table_add(&table, &network2, &mask2, &nexthop2, 2, ROUTE_STATIC);
-    route_table_add(&table, &network3, &mask3, &nexthop3, 3, ROUTE_STATIC);
-    
-    // Test IP in 192.168.1.130 - should match the /25 route
-    ip_addr_t test_ip1 = {192, 168, 1, 130};
-    uint32_t result = route_table_lookup(&table, &test_ip1, &route);
-    assert(result == SUCCESS);
-    assert(ip_addr_compare(&route.next_hop, &nexthop3) == 0);
-    
-    // Test IP in 192.168.1.10 - should match the /24 route
-    ip_addr_t test_ip2 = {192, 168, 1, 10};
-    result = route_table_lookup(&table, &test_ip2, &route);
-    assert(result == SUCCESS);
-    assert(ip_addr_compare(&route.next_hop, &nexthop2) == 0);
-    
-    // Test IP in 192.168.2.1 - should match the /16 route
-    ip_addr_t test_ip3 = {192, 168, 2, 1};
-    result = route_table_lookup(&table, &test_ip3, &route);
-    assert(result == SUCCESS);
-    assert(ip_addr_compare(&route.next_hop, &nexthop1) == 0);
-    
-    route_table_destroy(&table);
+    route_entry_t route1 = static_route("192.168.0.0", "255.255.0.0", "10.0.0.1", 1);       // /16
+    route_entry_t route2 = static_route("192.168.1.0", "255.255.255.0", "10.0.0.2", 2);     // /24
+    route_entry_t route3 = static_route("192.168.1.128", "255.255.255.128", "10.0.0.3", 3); // /25
+    ip_addr_t test_ip1 = v4("192.168.1.130");
+    ip_addr_t test_ip2 = v4("192.168.1.10");
+    ip_addr_t test_ip3 = v4("192.168.2.1");
+    ip_addr_t prefix;
+
+    assert(routing_table_add_route(&g_table, &route1) == STATUS_SUCCESS);
+    assert(routing_table_add_route(&g_table, &route2) == STATUS_SUCCESS);
+    assert(routing_table_add_route(&g_table, &route3) == STATUS_SUCCESS);
+
+    // 192.168.1.130 should match the /25 route
+    assert(routing_table_lookup(&g_table, &test_ip1, IP_TYPE_V4, &route) == STATUS_SUCCESS);
+    assert(route.route.ipv4.gateway == route3.route.ipv4.gateway);
+
+    // 192.168.1.10 should match the /24 route
+    assert(routing_table_lookup(&g_table, &test_ip2, IP_TYPE_V4, &route) == STATUS_SUCCESS);
+    assert(route.route.ipv4.gateway == route2.route.ipv4.gateway);
+
+    // 192.168.2.1 should match the /16 route
+    assert(routing_table_lookup(&g_table, &test_ip3, IP_TYPE_V4, &route) == STATUS_SUCCESS);
+    assert(route.route.ipv4.gateway == route1.route.ipv4.gateway);
+
+    // Once the /25 goes, its addresses fall back to the /24
+    prefix = v4("192.168.1.128");
+    assert(routing_remove_route_source(&prefix, 25, IP_TYPE_V4, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(routing_table_lookup(&g_table, &test_ip1, IP_TYPE_V4, &route) == STATUS_SUCCESS);
+    assert(route.route.ipv4.gateway == route2.route.ipv4.gateway);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    assert(route_count() == 0);
+
     printf(TEST_PASSED, "test_longest_prefix_match");
 }
 
+void test_route_source_preference() {
+    ip_addr_t prefix = v4("172.16.0.0");
+    ip_addr_t dest_ip = v4("172.16.5.5");
+    ip_addr_t ospf_nh = v4("10.1.1.1");
+    ip_addr_t static_nh = v4("10.2.2.2");
+    ip_addr_t next_hop;
+    uint16_t iface;
+
+    assert(routing_add_route(&prefix, 16, IP_TYPE_V4, &ospf_nh, 1, 10, ROUTE_TYPE_OSPF) == STATUS_SUCCESS);
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+    assert(next_hop.addr.v4 == ospf_nh.addr.v4 && iface == 1);
+
+    // Static has the lower administrative distance, whatever the metric
+    assert(routing_add_route(&prefix, 16, IP_TYPE_V4, &static_nh, 2, 100, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+    assert(next_hop.addr.v4 == static_nh.addr.v4 && iface == 2);
+    assert(route_count() == 2);
+
+    // Withdrawing the static route falls back to OSPF
+    assert(routing_remove_route_source(&prefix, 16, IP_TYPE_V4, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+    assert(next_hop.addr.v4 == ospf_nh.addr.v4 && iface == 1);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_source_preference");
+}
+
+void test_route_ecmp_nexthop_state() {
+    ip_addr_t prefix = v4("10.10.0.0");
+    ip_addr_t dest_ip = v4("10.10.1.1");
+    ip_addr_t nh1 = v4("10.0.0.1");
+    ip_addr_t nh2 = v4("10.0.0.2");
+    ip_addr_t next_hop;
+    uint16_t iface;
+    bool seen1 = false, seen2 = false;
+    uint32_t hash;
+
+    assert(routing_add_route(&prefix, 16, IP_TYPE_V4, &nh1, 1, 10, ROUTE_TYPE_OSPF) == STATUS_SUCCESS);
+    assert(routing_add_route(&prefix, 16, IP_TYPE_V4, &nh2, 2, 10, ROUTE_TYPE_OSPF) == STATUS_SUCCESS);
+
+    // Equal-cost paths share the flows
+    for (hash = 0; hash < 256; hash++) {
+        assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, hash * 0x9E3779B1U, &next_hop, &iface) ==
+               STATUS_SUCCESS);
+        seen1 |= (iface == 1);
+        seen2 |= (iface == 2);
+    }
+    assert(seen1 && seen2);
+
+    // A next hop that goes down stops taking flows
+    assert(routing_set_nexthop_state(&nh1, IP_TYPE_V4, 1, false) == STATUS_SUCCESS);
+    for (hash = 0; hash < 256; hash++) {
+        assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, hash * 0x9E3779B1U, &next_hop, &iface) ==
+               STATUS_SUCCESS);
+        assert(iface == 2 && next_hop.addr.v4 == nh2.addr.v4);
+    }
+
+    // With every path down the prefix does not forward
+    assert(routing_set_nexthop_state(&nh2, IP_TYPE_V4, 2, false) == STATUS_SUCCESS);
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_NOT_FOUND);
+
+    assert(routing_set_nexthop_state(&nh1, IP_TYPE_V4, 1, true) == STATUS_SUCCESS);
+    assert(routing_set_nexthop_state(&nh2, IP_TYPE_V4, 2, true) == STATUS_SUCCESS);
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_ecmp_nexthop_state");
+}
+
+void test_route_ipv6() {
+    ip_addr_t prefix = v6("2001:db8::");
+    ip_addr_t longer = v6("2001:db8:0:1::");
+    ip_addr_t nh1 = v6("fe80::1");
+    ip_addr_t nh2 = v6("fe80::2");
+    ip_addr_t dest1 = v6("2001:db8:0:1::42");
+    ip_addr_t dest2 = v6("2001:db8:ffff::1");
+    ip_addr_t miss = v6("2001:db9::1");
+    route_entry_t route;
+
+    assert(routing_add_route(&prefix, 32, IP_TYPE_V6, &nh1, 1, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(routing_add_route(&longer, 64, IP_TYPE_V6, &nh2, 2, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+
+    assert(routing_lookup(&dest1, IP_TYPE_V6, &route) == STATUS_SUCCESS);
+    assert(route.is_ipv6 && route.route.ipv6.prefix_len == 64);
+    assert(memcmp(&route.route.ipv6.next_hop, &nh2.addr.v6, sizeof(ipv6_addr_t)) == 0);
+
+    assert(routing_lookup(&dest2, IP_TYPE_V6, &route) == STATUS_SUCCESS);
+    assert(route.route.ipv6.prefix_len == 32 && route.interface_index == 1);
+
+    assert(routing_lookup(&miss, IP_TYPE_V6, &route) == STATUS_NOT_FOUND);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_ipv6");
+}
+
+void test_route_fib_stats() {
+    ip_addr_t prefix4 = v4("10.30.0.0");
+    ip_addr_t prefix6 = v6("2001:db8:30::");
+    ip_addr_t nh4 = v4("10.0.0.1");
+    ip_addr_t nh6 = v6("fe80::1");
+    routing_table_stats_t stats;
+
+    assert(routing_add_route(&prefix4, 16, IP_TYPE_V4, &nh4, 1, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(routing_add_route(&prefix6, 48, IP_TYPE_V6, &nh6, 1, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+
+    assert(routing_table_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.ipv4_routes == 1 && stats.ipv6_routes == 1);
+    assert(stats.ipv4_fib_memory > 0);
+    assert(stats.ipv6_lpm_memory > 0 && stats.ipv6_lpm_nodes > 0);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_fib_stats");
+}
+
+void test_route_rib_growth() {
+    ip_addr_t prefix = v4("10.160.0.0");
+    ip_addr_t nh = v4("10.0.0.1");
+    ip_addr_t dest_ip = v4("10.160.0.9");
+    route_entry_t route;
+    routing_table_stats_t stats;
+    uint32_t i;
+
+    // Well past the RIB's first allocation
+    for (i = 0; i < 3000; i++) {
+        prefix.addr.v4 = htonl(0x0AA00000U | (i << 8));
+        assert(routing_add_route(&prefix, 24, IP_TYPE_V4, &nh, 1 + i % 4, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    }
+    assert(routing_table_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.total_routes == 3000 && stats.fib_prefixes == 3000);
+    assert(stats.max_routes >= 3000 && stats.rib_memory > 0);
+
+    for (i = 0; i < 3000; i += 7) {
+        dest_ip.addr.v4 = htonl(0x0AA00009U | (i << 8));
+        assert(routing_lookup(&dest_ip, IP_TYPE_V4, &route) == STATUS_SUCCESS);
+        assert(route.interface_index == 1 + i % 4);
+    }
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    assert(route_count() == 0);
+    printf(TEST_PASSED, "test_route_rib_growth");
+}
+
+void test_route_fib_compress() {
+    ip_addr_t prefix = v4("10.120.0.0");
+    ip_addr_t dest_ip = v4("10.120.0.7");
+    ip_addr_t nh = v4("10.0.0.4");
+    ip_addr_t next_hop;
+    uint16_t iface;
+    routing_table_stats_t stats;
+    uint32_t i;
+
+    // A node of 256 host routes through one next hop
+    for (i = 0; i < 256; i++) {
+        prefix.addr.v4 = htonl(0x0A780000U | i);
+        assert(routing_add_route(&prefix, 32, IP_TYPE_V4, &nh, 4, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    }
+    assert(routing_table_get_stats(&stats) == STATUS_SUCCESS);
+#if CONFIG_FIB_COMPRESS
+    assert(stats.fib_folded_nodes >= 1);
+#else
+    assert(stats.fib_folded_nodes == 0 && stats.fib_nodes >= 1);
+#endif
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+    assert(iface == 4);
+
+    // Taking one route out unfolds the node again
+    prefix.addr.v4 = dest_ip.addr.v4;
+    assert(routing_remove_route_source(&prefix, 32, IP_TYPE_V4, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_NOT_FOUND);
+    dest_ip.addr.v4 = htonl(0x0A780008U);
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+    assert(routing_table_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.fib_folded_nodes == 0);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_fib_compress");
+}
+
+void test_route_trie_growth() {
+    ip_addr_t prefix = v4("10.140.0.1");
+    ip_addr_t nh = v4("10.0.0.1");
+    ip_addr_t next_hop;
+    uint16_t iface;
+    routing_table_stats_t before, after;
+    uint32_t i;
+
+    assert(routing_table_get_stats(&before) == STATUS_SUCCESS);
+
+    // Every host route below its own /24 takes a trie node, past the initial array
+    for (i = 0; i < 200; i++) {
+        prefix.addr.v4 = htonl(0x0A8C0001U | (i << 8));
+        assert(routing_add_route(&prefix, 32, IP_TYPE_V4, &nh, 1 + i % 8, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    }
+    assert(routing_table_get_stats(&after) == STATUS_SUCCESS);
+    assert(after.ipv4_fib_memory > before.ipv4_fib_memory);
+
+    for (i = 0; i < 200; i++) {
+        prefix.addr.v4 = htonl(0x0A8C0001U | (i << 8));
+        assert(routing_lookup_nexthop(&prefix, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+        assert(iface == 1 + i % 8);
+        prefix.addr.v4 = htonl(0x0A8C0002U | (i << 8));
+        assert(routing_lookup_nexthop(&prefix, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_NOT_FOUND);
+    }
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_trie_growth");
+}
+
+void test_route_prefix_lengths() {
+    ip_addr_t prefix = v4("10.140.128.0");
+    ip_addr_t dest_ip = v4("10.140.128.1");
+    ip_addr_t nh = v4("10.0.0.1");
+    route_entry_t route;
+    uint8_t len;
+
+    // The same address under every length from /8 to /24 is a distinct key
+    for (len = 8; len <= 24; len++) {
+        assert(routing_add_route(&prefix, len, IP_TYPE_V4, &nh, len, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    }
+    assert(route_count() == 17);
+
+    // Withdrawing the longest each time exposes the next one
+    for (len = 24; len > 8; len--) {
+        assert(routing_lookup(&dest_ip, IP_TYPE_V4, &route) == STATUS_SUCCESS);
+        assert(route.interface_index == len);
+        assert(routing_remove_route_source(&prefix, len, IP_TYPE_V4, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    }
+    assert(routing_lookup(&dest_ip, IP_TYPE_V4, &route) == STATUS_SUCCESS);
+    assert(route.interface_index == 8 && route_count() == 1);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_prefix_lengths");
+}
+
+void test_route_bulk_add() {
+    routing_route_t routes[16];
+    ip_addr_t nh = v4("10.0.0.5");
+    ip_addr_t dest_ip = v4("10.40.3.1");
+    ip_addr_t next_hop;
+    uint16_t iface;
+    uint32_t added = 0;
+    uint32_t i;
+
+    memset(routes, 0, sizeof(routes));
+    for (i = 0; i < 16; i++) {
+        routes[i].prefix.type = IP_TYPE_V4;
+        routes[i].prefix.addr.v4 = htonl(0x0A280000U | (i << 8));
+        routes[i].next_hop = nh;
+        routes[i].type = IP_TYPE_V4;
+        routes[i].prefix_len = 24;
+        routes[i].interface_index = 5;
+        routes[i].metric = 1;
+        routes[i].source = ROUTE_TYPE_STATIC;
+    }
+
+    // Inside an open batch nothing forwards until commit
+    assert(routing_table_begin_batch() == STATUS_SUCCESS);
+    assert(routing_add_routes_bulk(routes, 16, &added) == STATUS_SUCCESS);
+    assert(added == 16);
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_NOT_FOUND);
+    assert(routing_table_commit_batch() == STATUS_SUCCESS);
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+    assert(iface == 5);
+
+    // Without a batch the call commits on its own
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    assert(routing_add_routes_bulk(routes, 16, &added) == STATUS_SUCCESS);
+    assert(added == 16 && route_count() == 16);
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_bulk_add");
+}
+
+typedef struct {
+    volatile bool stop;
+    uint32_t lookups;
+    uint32_t bad;
+} lookup_reader_t;
+
+static void *lookup_reader(void *arg) {
+    lookup_reader_t *reader = (lookup_reader_t *)arg;
+    ip_addr_t dest_ip = v4("10.50.0.1");
+    ip_addr_t next_hop;
+    uint16_t iface;
+
+    while (!__atomic_load_n(&reader->stop, __ATOMIC_ACQUIRE)) {
+        status_t status = routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface);
+
+        // The covering /8 is always there; the /16 comes and goes
+        if (status != STATUS_SUCCESS || (iface != 1 && iface != 2)) {
+            reader->bad++;
+        }
+        reader->lookups++;
+    }
+    return NULL;
+}
+
+void test_route_concurrent_lookup() {
+    ip_addr_t covering = v4("10.0.0.0");
+    ip_addr_t prefix = v4("10.50.0.0");
+    ip_addr_t nh1 = v4("10.0.0.1");
+    ip_addr_t nh2 = v4("10.0.0.2");
+    lookup_reader_t reader;
+    pthread_t thread;
+    uint32_t i;
+
+    memset(&reader, 0, sizeof(reader));
+    assert(routing_add_route(&covering, 8, IP_TYPE_V4, &nh1, 1, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(pthread_create(&thread, NULL, lookup_reader, &reader) == 0);
+
+    // Lookups on another thread see one route or the other, never neither
+    for (i = 0; i < 2000; i++) {
+        assert(routing_add_route(&prefix, 16, IP_TYPE_V4, &nh2, 2, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+        assert(routing_remove_route_source(&prefix, 16, IP_TYPE_V4, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    }
+
+    __atomic_store_n(&reader.stop, true, __ATOMIC_RELEASE);
+    assert(pthread_join(thread, NULL) == 0);
+    assert(reader.bad == 0);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_concurrent_lookup");
+}
+
+void test_route_lookup_bulk() {
+    ip_addr_t prefix = v4("10.60.0.0");
+    ip_addr_t nh = v4("10.0.0.6");
+    ip_addr_t dst[ROUTING_LOOKUP_BULK_MAX];
+    uint32_t nh_index[ROUTING_LOOKUP_BULK_MAX];
+    uint64_t miss_mask = 0;
+    ip_addr_t next_hop;
+    uint16_t iface;
+    uint32_t i;
+
+    assert(routing_add_route(&prefix, 16, IP_TYPE_V4, &nh, 6, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+
+    // Even addresses hit the /16, odd ones miss
+    for (i = 0; i < ROUTING_LOOKUP_BULK_MAX; i++) {
+        dst[i] = v4((i & 1) ? "10.61.0.1" : "10.60.1.1");
+        dst[i].addr.v4 = htonl(ntohl(dst[i].addr.v4) + i);
+    }
+    assert(routing_lookup_bulk(dst, ROUTING_LOOKUP_BULK_MAX, IP_TYPE_V4, nh_index, &miss_mask) ==
+           STATUS_SUCCESS);
+    assert(miss_mask == 0xAAAAAAAAAAAAAAAAULL);
+    for (i = 0; i < ROUTING_LOOKUP_BULK_MAX; i += 2) {
+        assert(nh_index[i] != 0);
+        assert(routing_nexthop_select(nh_index[i], i, &next_hop, &iface) == STATUS_SUCCESS);
+        assert(iface == 6 && next_hop.addr.v4 == nh.addr.v4);
+    }
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_lookup_bulk");
+}
+
+void test_route_vrf() {
+    ip_addr_t prefix = v4("10.70.0.0");
+    ip_addr_t dest_ip = v4("10.70.0.1");
+    ip_addr_t nh_default = v4("10.0.0.1");
+    ip_addr_t nh_red = v4("10.0.0.2");
+    ip_addr_t shared = v4("10.80.0.0");
+    ip_addr_t shared_ip = v4("10.80.0.1");
+    ip_addr_t next_hop;
+    uint16_t iface;
+    route_entry_t route;
+
+    assert(routing_vrf_create(7) == STATUS_SUCCESS);
+    assert(routing_vrf_create(7) == STATUS_ALREADY_EXISTS);
+    assert(routing_interface_set_vrf(9, 7) == STATUS_SUCCESS);
+    assert(routing_interface_get_vrf(9) == 7);
+    assert(routing_interface_get_vrf(1) == ROUTING_VRF_DEFAULT);
+
+    // The same prefix forwards differently per VRF
+    assert(routing_add_route(&prefix, 16, IP_TYPE_V4, &nh_default, 1, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(routing_vrf_add_route(7, &prefix, 16, IP_TYPE_V4, &nh_red, 2, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(routing_vrf_lookup_nexthop(ROUTING_VRF_DEFAULT, &dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) ==
+           STATUS_SUCCESS);
+    assert(iface == 1);
+    assert(routing_vrf_lookup_nexthop(7, &dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+    assert(iface == 2);
+    assert(routing_vrf_lookup(7, &dest_ip, IP_TYPE_V4, &route) == STATUS_SUCCESS);
+    assert(route.route.ipv4.gateway == nh_red.addr.v4);
+
+    // A leaked prefix follows its source VRF
+    assert(routing_add_route(&shared, 16, IP_TYPE_V4, &nh_default, 3, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(routing_vrf_lookup_nexthop(7, &shared_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_NOT_FOUND);
+    assert(routing_vrf_leak_route(ROUTING_VRF_DEFAULT, &shared, 16, IP_TYPE_V4, 7) == STATUS_SUCCESS);
+    assert(routing_vrf_lookup_nexthop(7, &shared_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+    assert(iface == 3);
+    assert(routing_vrf_unleak_route(ROUTING_VRF_DEFAULT, &shared, 16, IP_TYPE_V4, 7) == STATUS_SUCCESS);
+    assert(routing_vrf_lookup_nexthop(7, &shared_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_NOT_FOUND);
+
+    assert(routing_vrf_remove_route(7, &prefix, 16, IP_TYPE_V4, NULL) == STATUS_SUCCESS);
+    assert(routing_vrf_lookup_nexthop(7, &dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_NOT_FOUND);
+    assert(routing_vrf_delete(7) == STATUS_SUCCESS);
+    assert(routing_interface_get_vrf(9) == ROUTING_VRF_DEFAULT);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_vrf");
+}
+
+void test_route_lookup_cache() {
+    ip_addr_t prefix = v4("10.90.0.0");
+    ip_addr_t longer = v4("10.90.1.0");
+    ip_addr_t dest_ip = v4("10.90.1.1");
+    ip_addr_t nh1 = v4("10.0.0.1");
+    ip_addr_t nh2 = v4("10.0.0.2");
+    routing_table_stats_t before, after;
+    route_entry_t route;
+    uint32_t i;
+
+    assert(routing_add_route(&prefix, 16, IP_TYPE_V4, &nh1, 1, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(routing_table_set_lookup_cache(true) == STATUS_SUCCESS);
+    assert(routing_table_get_stats(&before) == STATUS_SUCCESS);
+    assert(before.lookup_cache_enabled);
+
+    for (i = 0; i < 8; i++) {
+        assert(routing_lookup(&dest_ip, IP_TYPE_V4, &route) == STATUS_SUCCESS);
+        assert(route.interface_index == 1);
+    }
+    assert(routing_table_get_stats(&after) == STATUS_SUCCESS);
+    assert(after.lookup_cache_hits > before.lookup_cache_hits);
+
+    // A FIB change retires what the cache holds
+    assert(routing_add_route(&longer, 24, IP_TYPE_V4, &nh2, 2, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(routing_lookup(&dest_ip, IP_TYPE_V4, &route) == STATUS_SUCCESS);
+    assert(route.interface_index == 2);
+
+    assert(routing_table_set_lookup_cache(false) == STATUS_SUCCESS);
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_lookup_cache");
+}
+
+void test_route_batch() {
+    ip_addr_t prefix = v4("198.51.100.0");
+    ip_addr_t dest_ip = v4("198.51.100.7");
+    ip_addr_t nh = v4("10.0.0.9");
+    ip_addr_t next_hop;
+    uint16_t iface;
+    uint32_t generation;
+
+    // Inside a batch the FIB keeps forwarding the old way until commit
+    generation = routing_table_get_generation();
+    assert(routing_table_begin_batch() == STATUS_SUCCESS);
+    assert(routing_table_begin_batch() == STATUS_RESOURCE_BUSY);
+    assert(routing_add_route(&prefix, 24, IP_TYPE_V4, &nh, 3, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_NOT_FOUND);
+    assert(routing_table_commit_batch() == STATUS_SUCCESS);
+
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+    assert(iface == 3);
+    assert(routing_table_get_generation() != generation);
+
+    assert(routing_table_hw_sync_flush() == STATUS_SUCCESS);
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_batch");
+}
+
+void test_route_events() {
+    ip_addr_t prefix = v4("10.130.0.0");
+    ip_addr_t nh1 = v4("10.0.0.1");
+    ip_addr_t nh2 = v4("10.0.0.2");
+    event_feed_event_t events[8];
+    uint32_t count;
+    int fd;
+
+    assert(event_feed_subscribe(1U << EVENT_FEED_ROUTE_ADD | 1U << EVENT_FEED_ROUTE_DELETE |
+                                1U << EVENT_FEED_ROUTE_CHANGE, &fd) == STATUS_SUCCESS);
+    assert(event_feed_read(events, 8, &count) == STATUS_SUCCESS);
+
+    assert(routing_add_route(&prefix, 16, IP_TYPE_V4, &nh1, 1, 10, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(event_feed_read(events, 8, &count) == STATUS_SUCCESS);
+    assert(count == 1 && events[0].kind == EVENT_FEED_ROUTE_ADD);
+    assert(events[0].prefix_len == 16 && !events[0].is_ipv6);
+    assert(memcmp(events[0].addr, &prefix.addr.v4, 4) == 0);
+
+    // A better source replaces the next hops of the installed prefix
+    assert(routing_add_route(&prefix, 16, IP_TYPE_V4, &nh2, 2, 1, ROUTE_TYPE_CONNECTED) == STATUS_SUCCESS);
+    assert(event_feed_read(events, 8, &count) == STATUS_SUCCESS);
+    assert(count == 1 && events[0].kind == EVENT_FEED_ROUTE_CHANGE);
+
+    assert(routing_remove_route_source(&prefix, 16, IP_TYPE_V4, ROUTE_TYPE_CONNECTED) == STATUS_SUCCESS);
+    assert(routing_remove_route_source(&prefix, 16, IP_TYPE_V4, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(event_feed_read(events, 8, &count) == STATUS_SUCCESS);
+    assert(count == 2 && events[0].kind == EVENT_FEED_ROUTE_CHANGE && events[1].kind == EVENT_FEED_ROUTE_DELETE);
+
+    assert(event_feed_subscribe(0, NULL) == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_events");
+}
+
+void test_route_update_routes() {
+    routing_route_t routes[4];
+    status_t statuses[4];
+    ip_addr_t nh = v4("10.0.0.7");
+    uint32_t i;
+
+    memset(routes, 0, sizeof(routes));
+    for (i = 0; i < 4; i++) {
+        routes[i].prefix.type = IP_TYPE_V4;
+        routes[i].prefix.addr.v4 = htonl(0x0AA00000U | (i << 8));
+        routes[i].next_hop = nh;
+        routes[i].type = IP_TYPE_V4;
+        routes[i].prefix_len = 24;
+        routes[i].interface_index = 7;
+        routes[i].source = ROUTE_TYPE_STATIC;
+    }
+    // A bad prefix length fails on its own, the rest go in
+    routes[2].prefix_len = 40;
+
+    assert(routing_table_update_routes(routes, 4, false, false, statuses) != STATUS_SUCCESS);
+    assert(statuses[0] == STATUS_SUCCESS && statuses[1] == STATUS_SUCCESS);
+    assert(statuses[2] != STATUS_SUCCESS && statuses[3] == STATUS_SUCCESS);
+    assert(route_count() == 3);
+
+    // Stopping at the first error leaves the rest untried
+    routes[2].prefix_len = 24;
+    routes[1].source = ROUTE_TYPE_OSPF;
+    assert(routing_table_update_routes(routes, 4, true, true, statuses) != STATUS_SUCCESS);
+    assert(statuses[0] == STATUS_SUCCESS && statuses[1] == STATUS_NOT_FOUND);
+    assert(statuses[2] == STATUS_NOT_EXECUTED && statuses[3] == STATUS_NOT_EXECUTED);
+    assert(route_count() == 2);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_update_routes");
+}
+
+void test_route_hw_sync() {
+    ip_addr_t prefix = v4("10.100.0.0");
+    ip_addr_t other = v4("10.101.0.0");
+    ip_addr_t nh = v4("10.0.0.1");
+    routing_table_stats_t before, after;
+
+    assert(routing_table_hw_sync_flush() == STATUS_SUCCESS);
+    assert(routing_table_get_stats(&before) == STATUS_SUCCESS);
+    assert(before.hw_sync_enabled);
+
+    // An add and a delete of the same prefix in one batch cancel out
+    assert(routing_table_begin_batch() == STATUS_SUCCESS);
+    assert(routing_add_route(&prefix, 16, IP_TYPE_V4, &nh, 1, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(routing_table_commit_batch() == STATUS_SUCCESS);
+    assert(routing_remove_route_source(&prefix, 16, IP_TYPE_V4, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(routing_add_route(&other, 16, IP_TYPE_V4, &nh, 1, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(routing_table_hw_sync_flush() == STATUS_SUCCESS);
+
+    assert(routing_table_get_stats(&after) == STATUS_SUCCESS);
+    assert(after.hw_queue_depth == 0);
+    assert(after.hw_ops_queued >= before.hw_ops_queued + 3);
+    assert(after.hw_ops_programmed > before.hw_ops_programmed);
+    assert(after.hw_batches > before.hw_batches);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    assert(routing_table_hw_sync_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_hw_sync");
+}
+
+static uint32_t hw_routes(void) {
+    hw_resource_usage_t usage;
+
+    assert(routing_table_hw_sync_flush() == STATUS_SUCCESS);
+    assert(hw_resources_get_usage(HW_RESOURCE_ROUTE_TABLE, &usage) == STATUS_SUCCESS);
+    return usage.reserved;
+}
+
+void test_route_hw_resources() {
+    ip_addr_t prefix = v4("10.102.0.0");
+    ip_addr_t nh = v4("10.0.0.1");
+    routing_table_stats_t before, after;
+    hw_capabilities_t caps;
+    uint32_t i;
+
+    // Every route programmed into the hardware holds a route table entry
+    assert(hw_routes() == 0);
+    for (i = 0; i < 4; i++) {
+        prefix.addr.v4 = htonl(0x0A660000 | i << 8);
+        assert(routing_add_route(&prefix, 24, IP_TYPE_V4, &nh, 1, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    }
+    assert(hw_routes() == 4);
+
+    // With room for six, the last two of the next four are refused
+    assert(hw_resources_set_total(HW_RESOURCE_ROUTE_TABLE, 6) == STATUS_SUCCESS);
+    assert(routing_table_get_stats(&before) == STATUS_SUCCESS);
+    for (i = 4; i < 8; i++) {
+        prefix.addr.v4 = htonl(0x0A660000 | i << 8);
+        assert(routing_add_route(&prefix, 24, IP_TYPE_V4, &nh, 1, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    }
+    assert(hw_routes() == 6);
+    assert(routing_table_get_stats(&after) == STATUS_SUCCESS);
+    assert(after.hw_ops_failed == before.hw_ops_failed + 2);
+    assert(route_count() == 8);
+
+    // Withdrawing a refused route frees nothing; withdrawing a programmed one does
+    prefix.addr.v4 = htonl(0x0A660700);
+    assert(routing_remove_route_source(&prefix, 24, IP_TYPE_V4, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(hw_routes() == 6);
+    prefix.addr.v4 = htonl(0x0A660000);
+    assert(routing_remove_route_source(&prefix, 24, IP_TYPE_V4, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(hw_routes() == 5);
+
+    // A refused prefix whose route changes gets the freed entry
+    prefix.addr.v4 = htonl(0x0A660600);
+    assert(routing_add_route(&prefix, 24, IP_TYPE_V4, &nh, 1, 1, ROUTE_TYPE_CONNECTED) == STATUS_SUCCESS);
+    assert(hw_routes() == 6);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    assert(hw_routes() == 0);
+    assert(hw_resources_get_capabilities(&caps) == STATUS_SUCCESS);
+    assert(hw_resources_set_total(HW_RESOURCE_ROUTE_TABLE, caps.max_routes) == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_hw_resources");
+}
+
+void test_route_trace() {
+    ip_addr_t prefix = v4("10.150.0.0");
+    ip_addr_t nh = v4("10.0.0.1");
+    uint64_t recorded;
+
+    assert(trace_init() == STATUS_SUCCESS);
+    trace_clear();
+    trace_enable(1ULL << TRACE_ROUTE_ADD | 1ULL << TRACE_ROUTE_REMOVE);
+
+    // Installing and withdrawing the prefix records one event each
+    assert(routing_add_route(&prefix, 16, IP_TYPE_V4, &nh, 1, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(routing_remove_route_source(&prefix, 16, IP_TYPE_V4, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    trace_get_counts(&recorded, NULL);
+    assert(recorded == (CONFIG_ENABLE_TRACING ? 2 : 0));
+
+    trace_disable(1ULL << TRACE_ROUTE_ADD | 1ULL << TRACE_ROUTE_REMOVE);
+    trace_clear();
+    printf(TEST_PASSED, "test_route_trace");
+}
+
+void test_route_walk_and_pages() {
+    routing_route_t *routes = calloc(MANY_ROUTES, sizeof(*routes));
+    routing_route_t page[64];
+    table_cursor_t cursor = TABLE_CURSOR_START;
+    uint32_t added = 0, walked = 0, paged = 0, count;
+    ip_addr_t nh = v4("10.0.0.1");
+    uint32_t i;
+
+    assert(routes);
+    for (i = 0; i < MANY_ROUTES; i++) {
+        routes[i].prefix.type = IP_TYPE_V4;
+        routes[i].prefix.addr.v4 = htonl(0x0A000000U | (i << 8));
+        routes[i].next_hop = nh;
+        routes[i].type = IP_TYPE_V4;
+        routes[i].prefix_len = 24;
+        routes[i].interface_index = 1 + i % 4;
+        routes[i].metric = 1;
+        routes[i].source = ROUTE_TYPE_STATIC;
+    }
+    assert(routing_table_add_routes(routes, MANY_ROUTES, &added) == STATUS_SUCCESS);
+    assert(added == MANY_ROUTES);
+    assert(route_count() == MANY_ROUTES);
+
+    // Already present routes are skipped
+    assert(routing_table_add_routes(routes, 10, &added) == STATUS_SUCCESS);
+    assert(added == 0);
+
+    assert(routing_table_walk(count_route, &walked) == STATUS_SUCCESS);
+    assert(walked == MANY_ROUTES);
+
+    while (cursor != TABLE_CURSOR_END) {
+        assert(routing_table_get_routes_page(&cursor, page, 64, &count) == STATUS_SUCCESS);
+        assert(count <= 64);
+        paged += count;
+    }
+    assert(paged == MANY_ROUTES);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    free(routes);
+    printf(TEST_PASSED, "test_route_walk_and_pages");
+}
+
+void test_route_warm_restart() {
+    routing_route_t restored[3];
+    ip_addr_t nh = v4("10.0.0.1");
+    ip_addr_t dest_ip = v4("10.20.0.1");
+    ip_addr_t next_hop;
+    uint16_t iface;
+    uint32_t added = 0, removed = 0;
+    uint32_t i;
+
+    memset(restored, 0, sizeof(restored));
+    for (i = 0; i < 3; i++) {
+        restored[i].prefix.type = IP_TYPE_V4;
+        restored[i].prefix.addr.v4 = htonl(0x0A140000U | (i << 8));
+        restored[i].next_hop = nh;
+        restored[i].type = IP_TYPE_V4;
+        restored[i].prefix_len = 24;
+        restored[i].interface_index = 1;
+        restored[i].source = ROUTE_TYPE_BGP;
+    }
+
+    // Restored routes forward at once
+    assert(routing_table_restore_routes(restored, 3, &added) == STATUS_SUCCESS);
+    assert(added == 3);
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+
+    // The source refreshes one of them; the sweep takes the other two
+    assert(routing_add_route(&restored[0].prefix, 24, IP_TYPE_V4, &nh, 1, 0, ROUTE_TYPE_BGP) ==
+           STATUS_ALREADY_EXISTS);
+    assert(routing_table_sweep_stale(&removed) == STATUS_SUCCESS);
+    assert(removed == 2);
+    assert(route_count() == 1);
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+
+    assert(routing_table_sweep_stale(&removed) == STATUS_SUCCESS);
+    assert(removed == 0);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_warm_restart");
+}
+
+void test_route_backup_nexthop() {
+    ip_addr_t prefix = v4("10.110.0.0");
+    ip_addr_t dest_ip = v4("10.110.0.1");
+    ip_addr_t primary = v4("10.0.0.1");
+    ip_addr_t backup = v4("10.0.0.2");
+    ip_addr_t next_hop;
+    uint16_t iface;
+
+    assert(routing_set_backup_nexthop(&prefix, 16, IP_TYPE_V4, ROUTE_TYPE_OSPF, &backup, 2) == STATUS_NOT_FOUND);
+    assert(routing_add_route(&prefix, 16, IP_TYPE_V4, &primary, 1, 10, ROUTE_TYPE_OSPF) == STATUS_SUCCESS);
+    assert(routing_set_backup_nexthop(&prefix, 16, IP_TYPE_V4, ROUTE_TYPE_OSPF, &backup, 2) == STATUS_SUCCESS);
+
+    // The alternate only forwards once the primary is down
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+    assert(iface == 1);
+    assert(routing_set_nexthop_state(&primary, IP_TYPE_V4, 1, false) == STATUS_SUCCESS);
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+    assert(iface == 2 && next_hop.addr.v4 == backup.addr.v4);
+    assert(routing_set_nexthop_state(&primary, IP_TYPE_V4, 1, true) == STATUS_SUCCESS);
+    assert(routing_lookup_nexthop(&dest_ip, IP_TYPE_V4, 0, &next_hop, &iface) == STATUS_SUCCESS);
+    assert(iface == 1);
+
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_route_backup_nexthop");
+}
+
+void test_route_mem_account() {
+    ip_addr_t prefix = v4("10.150.0.0");
+    ip_addr_t nh = v4("10.0.0.1");
+    mem_account_stats_t stats;
+
+    // Everything the routing table holds is charged to the FIB
+    assert(routing_add_route(&prefix, 16, IP_TYPE_V4, &nh, 1, 1, ROUTE_TYPE_STATIC) == STATUS_SUCCESS);
+    assert(mem_account_get(MEM_TAG_FIB, &stats) == STATUS_SUCCESS);
+    assert(stats.heap_bytes > 0 && stats.heap_objects > 0);
+    assert(stats.heap_peak_bytes >= stats.heap_bytes);
+
+    // and given back in full on cleanup
+    assert(routing_table_cleanup() == STATUS_SUCCESS);
+    assert(mem_account_get(MEM_TAG_FIB, &stats) == STATUS_SUCCESS);
+    assert(stats.heap_bytes == 0 && stats.heap_objects == 0 && stats.arena_used_bytes == 0);
+
+    assert(routing_table_init(&g_table) == STATUS_SUCCESS);
+    assert(route_count() == 0);
+    printf(TEST_PASSED, "test_route_mem_account");
+}
+
 int main() {
     printf("Running Routing Table unit tests...\n");
-    
+
+    // Routes programmed into the hardware reserve route table entries
+    assert(hw_resources_init() == STATUS_SUCCESS);
+
     test_route_table_init();
     test_route_add();
     test_route_lookup();
     test_route_delete();
     test_longest_prefix_match();
-    
+    test_route_source_preference();
+    test_route_ecmp_nexthop_state();
+    test_route_ipv6();
+    test_route_fib_stats();
+    test_route_rib_growth();
+    test_route_fib_compress();
+    test_route_trie_growth();
+    test_route_prefix_lengths();
+    test_route_bulk_add();
+    test_route_concurrent_lookup();
+    test_route_lookup_bulk();
+    test_route_vrf();
+    test_route_lookup_cache();
+    test_route_batch();
+    test_route_update_routes();
+    test_route_hw_sync();
+    test_route_hw_resources();
+    test_route_events();
+    test_route_trace();
+    test_route_walk_and_pages();
+    test_route_warm_restart();
+    test_route_backup_nexthop();
+    test_route_mem_account();
+
+    assert(routing_table_cleanup() == STATUS_SUCCESS);
+    assert(hw_resources_shutdown() == STATUS_SUCCESS);
+
     printf("All Routing Table tests completed successfully.\n");
     return 0;
 }
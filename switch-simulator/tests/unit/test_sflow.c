@@ -0,0 +1,256 @@
+/**
+ * @file test_sflow.c
+ * @brief Unit tests for the sFlow agent
+ *
+ * The collector is a UDP socket on the loopback; the tests decode the
+ * datagrams the exporter sends it.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "../../include/management/sflow.h"
+#include "../../include/hal/packet.h"
+#include "../../include/hal/port.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define SAMPLED_PORT 1
+#define OTHER_PORT 2
+#define AGENT_ADDRESS 0x0A000001u
+#define SUB_AGENT 3
+#define FRAME_LEN 200
+#define BURST 32
+#define RATE 10
+#define RATE_FRAMES 2000
+#define COLLECTOR_BUFFER (1 << 20)
+
+/* What the collector decoded */
+typedef struct {
+    uint32_t datagrams;
+    uint32_t flows;
+    uint32_t counters;
+} collected_t;
+
+static int g_collector = -1;
+static uint16_t g_collector_port;
+static uint32_t g_last_seq;
+
+static uint32_t get_u32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void open_collector(void) {
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    struct timeval timeout = { .tv_sec = 2 };
+    socklen_t len = sizeof(addr);
+    int size = COLLECTOR_BUFFER;
+
+    g_collector = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(g_collector >= 0);
+    assert(bind(g_collector, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(getsockname(g_collector, (struct sockaddr *)&addr, &len) == 0);
+    assert(setsockopt(g_collector, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0);
+    // A burst of samples leaves as datagrams back to back
+    assert(setsockopt(g_collector, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) == 0);
+    g_collector_port = ntohs(addr.sin_port);
+}
+
+/* Run frames received on a port through the ingress pipeline */
+static void receive(port_id_t port, uint32_t count) {
+    packet_buffer_t *pkts[BURST];
+    packet_result_t results[BURST];
+    uint8_t frame[FRAME_LEN];
+
+    for (uint32_t i = 0; i < FRAME_LEN; i++) {
+        frame[i] = (uint8_t)i;
+    }
+    while (count) {
+        uint32_t n = count < BURST ? count : BURST;
+
+        for (uint32_t i = 0; i < n; i++) {
+            pkts[i] = packet_buffer_alloc(FRAME_LEN);
+            assert(pkts[i] != NULL);
+            assert(packet_append_data(pkts[i], frame, FRAME_LEN) == STATUS_SUCCESS);
+            pkts[i]->metadata.port = port;
+        }
+        assert(packet_process_burst(pkts, n, results) == STATUS_SUCCESS);
+        for (uint32_t i = 0; i < n; i++) {
+            assert(results[i] == PACKET_RESULT_FORWARD);
+            packet_buffer_free(pkts[i]);
+        }
+        count -= n;
+    }
+}
+
+/* Check a flow sample of the sampled port and its raw header record */
+static void check_flow_sample(const uint8_t *p, uint32_t length, uint32_t rate) {
+    uint32_t header_length = FRAME_LEN < CONFIG_SFLOW_HEADER_BYTES ? FRAME_LEN : CONFIG_SFLOW_HEADER_BYTES;
+
+    assert(length == 32 + 8 + 16 + ((header_length + 3) & ~3u));
+    assert(get_u32(p + 4) == SAMPLED_PORT + 1);
+    assert(get_u32(p + 8) == rate && get_u32(p + 12) >= 1 && get_u32(p + 16) == 0);
+    assert(get_u32(p + 20) == SAMPLED_PORT + 1 && get_u32(p + 24) == 0 && get_u32(p + 28) == 1);
+
+    // Raw Ethernet header record; the frame length counts an FCS
+    p += 32;
+    assert(get_u32(p) == 1 && get_u32(p + 8) == 1);
+    assert(get_u32(p + 12) == FRAME_LEN + 4 && get_u32(p + 16) == 4 && get_u32(p + 20) == header_length);
+    for (uint32_t i = 0; i < header_length; i++) {
+        assert(p[24 + i] == (uint8_t)i);
+    }
+}
+
+/* Read datagrams until enough flow samples, or a counter sample, have arrived */
+static void collect(collected_t *got, uint32_t flows, bool counters, uint32_t rate) {
+    uint8_t buf[SFLOW_MAX_DATAGRAM];
+
+    while (got->flows < flows || (counters && got->counters == 0)) {
+        ssize_t n = recv(g_collector, buf, sizeof(buf), 0);
+        const uint8_t *p = buf + 28;
+
+        assert(n >= 28);
+        assert(get_u32(buf) == SFLOW_VERSION && get_u32(buf + 4) == 1);
+        assert(get_u32(buf + 8) == AGENT_ADDRESS && get_u32(buf + 12) == SUB_AGENT);
+        // Datagrams are numbered from 1 with no gap
+        assert(get_u32(buf + 16) == ++g_last_seq);
+        got->datagrams++;
+
+        for (uint32_t s = get_u32(buf + 24); s > 0; s--) {
+            uint32_t format = get_u32(p);
+            uint32_t length = get_u32(p + 4);
+
+            assert(p + 8 + length <= buf + n);
+            if (format == 1) {
+                check_flow_sample(p + 8, length, rate);
+                got->flows++;
+            } else {
+                // Generic interface counters of the sampled port, an Ethernet
+                assert(format == 2 && length == 12 + 8 + 88);
+                assert(get_u32(p + 12) == SAMPLED_PORT + 1 && get_u32(p + 16) == 1);
+                assert(get_u32(p + 20) == 1 && get_u32(p + 28) == SAMPLED_PORT + 1 && get_u32(p + 32) == 6);
+                got->counters++;
+            }
+            p += 8 + length;
+        }
+        assert(p == buf + n);
+    }
+}
+
+void test_sflow_config() {
+    sflow_config_t config = { .host = NULL };
+    sflow_stats_t stats;
+
+    assert(sflow_set_port_rate(SAMPLED_PORT, 1) == STATUS_NOT_INITIALIZED);
+    assert(sflow_get_stats(&stats) == STATUS_NOT_INITIALIZED);
+    assert(sflow_shutdown() == STATUS_NOT_INITIALIZED);
+    assert(sflow_init(NULL) == STATUS_INVALID_PARAMETER);
+    assert(sflow_init(&config) == STATUS_INVALID_PARAMETER);
+
+    config.host = "127.0.0.1";
+    config.port = g_collector_port;
+    config.agent_address = AGENT_ADDRESS;
+    config.sub_agent_id = SUB_AGENT;
+    config.flush_interval_ms = 10;
+    config.counter_interval_s = 1;
+    assert(sflow_init(&config) == STATUS_SUCCESS);
+    assert(sflow_init(&config) == STATUS_ALREADY_INITIALIZED);
+
+    // Every port starts unsampled
+    assert(sflow_get_port_rate(SAMPLED_PORT) == 0);
+    assert(sflow_set_port_rate(CONFIG_MAX_PORTS, 1) == STATUS_INVALID_PARAMETER);
+    assert(sflow_set_port_rate(SAMPLED_PORT, (1U << 30) + 1) == STATUS_INVALID_PARAMETER);
+    assert(sflow_get_port_rate(CONFIG_MAX_PORTS) == 0);
+    assert(sflow_get_stats(NULL) == STATUS_INVALID_PARAMETER);
+    assert(sflow_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.samples == 0 && stats.datagrams_sent == 0);
+
+    printf(TEST_PASSED, "test_sflow_config");
+}
+
+void test_sflow_every_frame() {
+    collected_t got = { 0 };
+    sflow_stats_t stats;
+
+    // A rate of 1 samples every frame of the port and nothing else
+    assert(sflow_set_port_rate(SAMPLED_PORT, 1) == STATUS_SUCCESS);
+    assert(sflow_get_port_rate(SAMPLED_PORT) == 1);
+    receive(SAMPLED_PORT, 10);
+    receive(OTHER_PORT, 10);
+    collect(&got, 10, false, 1);
+    assert(got.flows == 10);
+
+    assert(sflow_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.samples == 10 && stats.ring_drops == 0 && stats.flow_samples_sent == 10);
+    assert(stats.datagrams_sent >= got.datagrams && stats.send_errors == 0);
+
+    printf(TEST_PASSED, "test_sflow_every_frame");
+}
+
+void test_sflow_rate() {
+    collected_t got = { 0 };
+    sflow_stats_t before, after;
+    uint64_t samples;
+
+    assert(sflow_get_stats(&before) == STATUS_SUCCESS);
+
+    // One in RATE on average, with random skips
+    assert(sflow_set_port_rate(SAMPLED_PORT, RATE) == STATUS_SUCCESS);
+    receive(SAMPLED_PORT, RATE_FRAMES);
+    assert(sflow_get_stats(&after) == STATUS_SUCCESS);
+    samples = after.samples - before.samples;
+    assert(samples > RATE_FRAMES / RATE * 8 / 10 && samples < RATE_FRAMES / RATE * 12 / 10);
+
+    collect(&got, (uint32_t)samples, false, RATE);
+    assert(got.flows == samples);
+
+    printf(TEST_PASSED, "test_sflow_rate");
+}
+
+void test_sflow_counters() {
+    collected_t got = { 0 };
+    sflow_stats_t stats;
+
+
+    // Sampled ports are polled every counter interval
+    collect(&got, 0, true, RATE);
+    assert(got.counters == 1);
+    assert(sflow_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.counter_samples_sent >= 1);
+
+    assert(sflow_set_port_rate(SAMPLED_PORT, 0) == STATUS_SUCCESS);
+    assert(sflow_get_port_rate(SAMPLED_PORT) == 0);
+    receive(SAMPLED_PORT, 100);
+    assert(sflow_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.flow_samples_sent == stats.samples);
+
+    printf(TEST_PASSED, "test_sflow_counters");
+}
+
+int main() {
+    printf("Running sFlow unit tests...\n");
+
+    assert(packet_init() == STATUS_SUCCESS);
+    assert(port_init() == STATUS_SUCCESS);
+    open_collector();
+
+    test_sflow_config();
+    test_sflow_every_frame();
+    test_sflow_rate();
+    test_sflow_counters();
+
+    assert(sflow_shutdown() == STATUS_SUCCESS);
+    close(g_collector);
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All sFlow tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,167 @@
+/**
+ * @file test_sim_clock.c
+ * @brief Unit tests for the real and virtual simulator clock
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../../include/common/sim_clock.h"
+#include "../../include/common/event_loop.h"
+#include "../../include/common/config.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define HOUR_US (3600ULL * 1000000)
+#define THREADS 4
+#define ADVANCES 10000
+
+typedef struct {
+    uint64_t fired_at[3];
+    int count;
+} fire_log_t;
+
+static uint64_t g_base_us;
+
+/* System monotonic time, for telling skipped time from time spent */
+static uint64_t real_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/* Moves the clock to rising targets from several threads at once */
+static void *advance_thread(void *arg) {
+    uint64_t offset = (uint64_t)(uintptr_t)arg;
+
+    for (uint64_t i = 0; i < ADVANCES; i++) {
+        uint64_t before = sim_clock_now_us();
+        assert(sim_clock_advance_to_us(g_base_us + i * THREADS + offset) == STATUS_SUCCESS);
+        assert(sim_clock_now_us() >= before);
+    }
+    return NULL;
+}
+
+static void log_fire(event_timer_t *timer, void *arg) {
+    fire_log_t *log = (fire_log_t *)arg;
+
+    (void)timer;
+    log->fired_at[log->count++] = event_loop_now_us();
+    if (log->count == 3) {
+        event_loop_stop();
+    }
+}
+
+void test_sim_clock_realtime() {
+    uint64_t before;
+
+    assert(sim_clock_get_mode() == SIM_CLOCK_REALTIME);
+    assert(!sim_clock_is_virtual());
+    assert(sim_clock_set_mode((sim_clock_mode_t)2) == STATUS_INVALID_PARAMETER);
+
+    // Real time moves by itself and cannot be pushed
+    before = sim_clock_now_us();
+    usleep(2000);
+    assert(sim_clock_now_us() - before >= 2000);
+    assert(sim_clock_advance_us(1000) == STATUS_NOT_SUPPORTED);
+    assert(sim_clock_advance_to_us(before + HOUR_US) == STATUS_NOT_SUPPORTED);
+    assert(sim_clock_now_us() < before + HOUR_US);
+    assert(labs((long)(sim_clock_time() - time(NULL))) <= 1);
+
+    printf(TEST_PASSED, "test_sim_clock_realtime");
+}
+
+void test_sim_clock_virtual() {
+    pthread_t threads[THREADS];
+    uint64_t start;
+    time_t wall;
+
+    // The virtual clock starts where the real one was, then stands still
+    start = sim_clock_now_us();
+    assert(sim_clock_set_mode(SIM_CLOCK_VIRTUAL) == STATUS_SUCCESS);
+    assert(sim_clock_is_virtual());
+    assert(sim_clock_now_us() >= start);
+    start = sim_clock_now_us();
+    wall = sim_clock_time();
+    usleep(2000);
+    assert(sim_clock_now_us() == start);
+
+    // Entering virtual mode again keeps the time skipped so far
+    assert(sim_clock_advance_us(500) == STATUS_SUCCESS);
+    assert(sim_clock_set_mode(SIM_CLOCK_VIRTUAL) == STATUS_SUCCESS);
+    assert(sim_clock_now_us() == start + 500);
+
+    // It moves forward only, and the wall clock moves with it
+    assert(sim_clock_advance_to_us(start + 1000) == STATUS_SUCCESS);
+    assert(sim_clock_now_us() == start + 1000);
+    assert(sim_clock_advance_to_us(start) == STATUS_SUCCESS);
+    assert(sim_clock_now_us() == start + 1000);
+    assert(sim_clock_advance_us(HOUR_US) == STATUS_SUCCESS);
+    assert(sim_clock_now_us() == start + 1000 + HOUR_US);
+    assert(sim_clock_time() - wall >= 3600 && sim_clock_time() - wall <= 3601);
+
+    // Threads racing to move it leave it at the furthest target
+    g_base_us = sim_clock_now_us();
+    for (int i = 0; i < THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, advance_thread, (void *)(uintptr_t)i) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+    assert(sim_clock_now_us() == g_base_us + (ADVANCES - 1) * THREADS + THREADS - 1);
+
+    printf(TEST_PASSED, "test_sim_clock_virtual");
+}
+
+void test_sim_clock_event_loop() {
+    const uint64_t delays[3] = { HOUR_US, 5 * 1000000, 24 * HOUR_US };
+    event_timer_t timers[3];
+    event_loop_stats_t stats;
+    fire_log_t log = { .count = 0 };
+    uint64_t start;
+    uint64_t real_start;
+
+    assert(event_loop_init() == STATUS_SUCCESS);
+
+    // A day of timers runs at once, in deadline order, each on its deadline
+    start = event_loop_now_us();
+    real_start = real_us();
+    for (int i = 0; i < 3; i++) {
+        event_timer_init(&timers[i], log_fire, &log);
+        assert(event_timer_start(&timers[i], delays[i], 0) == STATUS_SUCCESS);
+    }
+    assert(event_loop_run() == STATUS_SUCCESS);
+    assert(real_us() - real_start < 1000000);
+
+    assert(log.count == 3);
+    assert(log.fired_at[0] - start >= delays[1] && log.fired_at[0] - start < delays[1] + 1000);
+    assert(log.fired_at[1] - start >= delays[0] && log.fired_at[1] - start < delays[0] + 1000);
+    assert(log.fired_at[2] - start >= delays[2] && log.fired_at[2] - start < delays[2] + 1000);
+    assert(event_loop_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.clock_jumps >= 3 && stats.timers_fired == 3);
+
+    assert(event_loop_shutdown() == STATUS_SUCCESS);
+
+    printf(TEST_PASSED, "test_sim_clock_event_loop");
+}
+
+int main() {
+    printf("Running sim clock unit tests...\n");
+
+    test_sim_clock_realtime();
+    test_sim_clock_virtual();
+    test_sim_clock_event_loop();
+
+    // Back on real time, the skipped time is gone
+    assert(sim_clock_set_mode(SIM_CLOCK_REALTIME) == STATUS_SUCCESS);
+    assert(sim_clock_now_us() < g_base_us);
+
+    printf("All sim clock tests completed successfully.\n");
+    return 0;
+}
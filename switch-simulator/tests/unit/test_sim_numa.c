@@ -0,0 +1,106 @@
+/**
+ * @file test_sim_numa.c
+ * @brief Unit tests for NUMA topology and memory placement
+ *
+ * The node layout is the host's; checks hold for one node as for several.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <stdint.h>
+#include "../../include/common/sim_numa.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define MAX_CPUS 16
+
+void test_sim_numa_cpu_list() {
+    uint32_t cpus[MAX_CPUS];
+
+    assert(sim_numa_parse_cpu_list("0-3,8,10-11", cpus, MAX_CPUS) == 7);
+    assert(cpus[0] == 0 && cpus[3] == 3 && cpus[4] == 8 && cpus[5] == 10 && cpus[6] == 11);
+
+    // As read from sysfs, with its newline
+    assert(sim_numa_parse_cpu_list("5\n", cpus, MAX_CPUS) == 1 && cpus[0] == 5);
+
+    // List order is kept, and the list stops at max
+    assert(sim_numa_parse_cpu_list("7,2", cpus, MAX_CPUS) == 2 && cpus[0] == 7 && cpus[1] == 2);
+    assert(sim_numa_parse_cpu_list("0-31", cpus, MAX_CPUS) == MAX_CPUS && cpus[MAX_CPUS - 1] == MAX_CPUS - 1);
+
+    assert(sim_numa_parse_cpu_list("", cpus, MAX_CPUS) == 0);
+    assert(sim_numa_parse_cpu_list("3-1", cpus, MAX_CPUS) == 0);
+    assert(sim_numa_parse_cpu_list("1-", cpus, MAX_CPUS) == 0);
+    assert(sim_numa_parse_cpu_list("1;2", cpus, MAX_CPUS) == 0);
+    assert(sim_numa_parse_cpu_list("a", cpus, MAX_CPUS) == 0);
+    assert(sim_numa_parse_cpu_list(NULL, cpus, MAX_CPUS) == 0);
+    assert(sim_numa_parse_cpu_list("1", NULL, MAX_CPUS) == 0);
+
+    printf(TEST_PASSED, "test_sim_numa_cpu_list");
+}
+
+void test_sim_numa_topology() {
+    uint32_t nodes = sim_numa_node_count();
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+    assert(nodes >= 1);
+    for (long cpu = 0; cpu < online; cpu++) {
+        assert(sim_numa_node_of_cpu((uint32_t)cpu) < nodes);
+    }
+    assert(sim_numa_node_of_cpu(UINT32_MAX) == 0);
+    assert(sim_numa_current_node() < nodes);
+    assert(sim_numa_current_node() == sim_numa_current_node());
+
+    // One node has nothing to replicate over
+    if (nodes == 1) {
+        assert(!sim_numa_replicate_tables());
+    }
+
+    printf(TEST_PASSED, "test_sim_numa_topology");
+}
+
+void test_sim_numa_memory() {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uint32_t nodes = sim_numa_node_count();
+    uint8_t buf[64];
+
+    // Whole zeroed pages, on every node
+    for (uint32_t node = 0; node < nodes; node++) {
+        size_t size = 3 * page + 100;
+        uint8_t *mem = (uint8_t *)sim_numa_alloc(size, node);
+
+        assert(mem != NULL);
+        assert(((uintptr_t)mem & (page - 1)) == 0);
+        for (size_t i = 0; i < size; i += 97) {
+            assert(mem[i] == 0);
+        }
+        memset(mem, 0xA5, size);
+        assert(mem[size - 1] == 0xA5);
+        sim_numa_free(mem, size);
+    }
+    assert(sim_numa_alloc(0, 0) == NULL);
+    assert(sim_numa_alloc(page, nodes) == NULL);
+    sim_numa_free(NULL, page);
+
+    // Memory within a page is left where it is; a bad node is refused
+    assert(sim_numa_bind_memory(buf, sizeof(buf), 0) == STATUS_SUCCESS);
+    assert(sim_numa_bind_memory(NULL, page, 0) == STATUS_SUCCESS);
+    assert(sim_numa_bind_memory(buf, sizeof(buf), nodes) == STATUS_INVALID_PARAMETER);
+
+    printf(TEST_PASSED, "test_sim_numa_memory");
+}
+
+int main() {
+    printf("Running NUMA unit tests...\n");
+
+    test_sim_numa_cpu_list();
+    test_sim_numa_topology();
+    test_sim_numa_memory();
+
+    printf("All NUMA tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,227 @@
+/**
+ * @file test_sim_timing.c
+ * @brief Unit tests for the ASIC timing model
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../../include/hal/sim_timing.h"
+#include "../../include/hal/packet.h"
+#include "../../include/common/config.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define MAX_RELEASED 64
+#define FULL_FRAME 1500
+#define WAIT_POLLS 2000
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t g_tags[MAX_RELEASED];
+static port_id_t g_ports[MAX_RELEASED];
+static uint32_t g_released;
+
+/* Keeps the tag and port of every packet released, in order */
+static void release(port_id_t port_id, packet_buffer_t **pkts, uint32_t count) {
+    pthread_mutex_lock(&g_lock);
+    for (uint32_t i = 0; i < count; i++) {
+        if (g_released < MAX_RELEASED) {
+            g_tags[g_released] = pkts[i]->data[0];
+            g_ports[g_released] = port_id;
+            g_released++;
+        }
+        packet_buffer_free(pkts[i]);
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+static uint32_t released(void) {
+    uint32_t n;
+
+    pthread_mutex_lock(&g_lock);
+    n = g_released;
+    pthread_mutex_unlock(&g_lock);
+    return n;
+}
+
+static void wait_released(uint32_t expected) {
+    for (int i = 0; i < WAIT_POLLS && released() < expected; i++) {
+        usleep(1000);
+    }
+    assert(released() == expected);
+}
+
+static packet_buffer_t *make_packet(uint8_t tag, uint32_t length) {
+    uint8_t frame[FULL_FRAME];
+    packet_buffer_t *pkt = packet_buffer_alloc(length);
+
+    assert(pkt != NULL);
+    memset(frame, 0, sizeof(frame));
+    frame[0] = tag;
+    assert(packet_append_data(pkt, frame, length) == STATUS_SUCCESS);
+    return pkt;
+}
+
+/* Every stage fixed at latency_ns, no table accesses, no jitter */
+static void set_stages(uint32_t latency_ns) {
+    sim_timing_stage_config_t stage = { .latency_ns = latency_ns };
+
+    for (int i = 0; i < SIM_TIMING_STAGE_COUNT; i++) {
+        assert(sim_timing_set_stage((sim_timing_stage_t)i, &stage) == STATUS_SUCCESS);
+    }
+}
+
+static uint32_t submit(port_id_t port, port_speed_t speed, uint8_t first_tag,
+                       uint32_t count, uint32_t length) {
+    packet_buffer_t *pkts[16];
+
+    assert(count <= 16);
+    for (uint32_t i = 0; i < count; i++) {
+        pkts[i] = make_packet((uint8_t)(first_tag + i), length);
+    }
+    uint32_t taken = sim_timing_submit(port, speed, pkts, count);
+    for (uint32_t i = taken; i < count; i++) {
+        packet_buffer_free(pkts[i]);
+    }
+    return taken;
+}
+
+void test_sim_timing_config() {
+    sim_timing_stage_config_t stage;
+    sim_timing_stage_config_t custom = { .latency_ns = 50, .memory_accesses = 3, .jitter_ns = 10 };
+
+    // Off until enabled
+    assert(!sim_timing_enabled());
+    assert(sim_timing_enable(true) == STATUS_SUCCESS);
+    assert(sim_timing_enabled());
+    assert(sim_timing_enable(false) == STATUS_SUCCESS);
+    assert(!sim_timing_enabled());
+
+    // The defaults split the packet delay over the stages
+    assert(sim_timing_get_stage(SIM_TIMING_STAGE_L2, &stage) == STATUS_SUCCESS);
+    assert(stage.latency_ns == CONFIG_SIM_PACKET_DELAY_US * 1000 / SIM_TIMING_STAGE_COUNT);
+    assert(stage.memory_accesses == 2 && stage.jitter_ns == 0);
+
+    assert(sim_timing_set_stage(SIM_TIMING_STAGE_ACL, &custom) == STATUS_SUCCESS);
+    assert(sim_timing_get_stage(SIM_TIMING_STAGE_ACL, &stage) == STATUS_SUCCESS);
+    assert(memcmp(&stage, &custom, sizeof(stage)) == 0);
+    assert(sim_timing_set_stage(SIM_TIMING_STAGE_COUNT, &custom) == STATUS_INVALID_PARAMETER);
+    assert(sim_timing_set_stage(SIM_TIMING_STAGE_ACL, NULL) == STATUS_INVALID_PARAMETER);
+    assert(sim_timing_get_stage(SIM_TIMING_STAGE_COUNT, &stage) == STATUS_INVALID_PARAMETER);
+
+    assert(sim_timing_room() == CONFIG_SIM_TIMING_MAX_PACKETS);
+    assert(sim_timing_submit(MAX_PORTS, PORT_SPEED_1G, NULL, 1) == 0);
+
+    printf(TEST_PASSED, "test_sim_timing_config");
+}
+
+void test_sim_timing_serialization() {
+    const uint64_t full_ns = (FULL_FRAME + SIM_TIMING_WIRE_OVERHEAD) * 8;    /* At 1G */
+    sim_timing_port_stats_t stats;
+
+    set_stages(0);
+    g_released = 0;
+
+    // Back-to-back frames leave one serialization time apart, in order
+    assert(submit(1, PORT_SPEED_1G, 0, 10, FULL_FRAME) == 10);
+    assert(sim_timing_room() <= CONFIG_SIM_TIMING_MAX_PACKETS - 10 + released());
+    assert(sim_timing_get_port_stats(1, &stats) == STATUS_SUCCESS);
+    assert(stats.packets == 10 && stats.bytes == 10 * (FULL_FRAME + SIM_TIMING_WIRE_OVERHEAD));
+    assert(stats.latency_min_ns + 1 >= full_ns && stats.latency_min_ns <= full_ns);
+    assert(stats.latency_max_ns - stats.latency_min_ns + 1 >= 9 * full_ns);
+    assert(stats.latency_max_ns - stats.latency_min_ns <= 9 * full_ns + 1);
+    assert(stats.jitter_ns > 0 && stats.clamped == 0);
+
+    wait_released(10);
+    for (uint32_t i = 0; i < 10; i++) {
+        assert(g_tags[i] == i && g_ports[i] == 1);
+    }
+    assert(sim_timing_get_port_stats(1, &stats) == STATUS_SUCCESS);
+    assert(stats.released == 10 && stats.pending == 0);
+    assert(stats.release_late_total_ns >= stats.release_late_max_ns);
+    assert(sim_timing_room() == CONFIG_SIM_TIMING_MAX_PACKETS);
+
+    // Short frames are padded to the minimum; an unknown speed adds nothing
+    assert(sim_timing_clear_port_stats(2) == STATUS_SUCCESS);
+    assert(submit(2, PORT_SPEED_1G, 20, 1, 20) == 1);
+    assert(sim_timing_get_port_stats(2, &stats) == STATUS_SUCCESS);
+    assert(stats.bytes == SIM_TIMING_MIN_FRAME + SIM_TIMING_WIRE_OVERHEAD);
+    assert(sim_timing_clear_port_stats(3) == STATUS_SUCCESS);
+    assert(submit(3, PORT_SPEED_UNKNOWN, 30, 1, FULL_FRAME) == 1);
+    assert(sim_timing_get_port_stats(3, &stats) == STATUS_SUCCESS);
+    assert(stats.latency_max_ns == 0);
+    wait_released(12);
+
+    // Clearing keeps nothing but what is still pending
+    assert(sim_timing_clear_port_stats(1) == STATUS_SUCCESS);
+    assert(sim_timing_get_port_stats(1, &stats) == STATUS_SUCCESS);
+    assert(stats.packets == 0 && stats.released == 0 && stats.jitter_ns == 0);
+    assert(sim_timing_clear_port_stats(MAX_PORTS) == STATUS_INVALID_PARAMETER);
+    assert(sim_timing_get_port_stats(MAX_PORTS, &stats) == STATUS_INVALID_PARAMETER);
+
+    printf(TEST_PASSED, "test_sim_timing_serialization");
+}
+
+void test_sim_timing_pipeline() {
+    sim_timing_port_stats_t stats;
+    uint32_t horizon_ms = CONFIG_SIM_TIMING_BUCKETS * CONFIG_SIM_TIMING_BUCKET_NS / 1000000;
+
+    g_released = 0;
+
+    // Stage latency comes before the wire; L3 is skipped for non-IP frames
+    set_stages(1000);
+    assert(sim_timing_clear_port_stats(4) == STATUS_SUCCESS);
+    assert(submit(4, PORT_SPEED_UNKNOWN, 0, 1, FULL_FRAME) == 1);
+    assert(sim_timing_get_port_stats(4, &stats) == STATUS_SUCCESS);
+    assert(stats.latency_min_ns >= (SIM_TIMING_STAGE_COUNT - 1) * 1000 - 1);
+    assert(stats.latency_min_ns <= (SIM_TIMING_STAGE_COUNT - 1) * 1000);
+    wait_released(1);
+
+    // A departure past the calendar horizon is counted and released early
+    set_stages((horizon_ms + 10) * 1000000 / SIM_TIMING_STAGE_COUNT);
+    assert(sim_timing_clear_port_stats(4) == STATUS_SUCCESS);
+    assert(submit(4, PORT_SPEED_UNKNOWN, 1, 1, FULL_FRAME) == 1);
+    assert(sim_timing_get_port_stats(4, &stats) == STATUS_SUCCESS);
+    assert(stats.clamped == 1);
+    wait_released(2);
+
+    // A slow port backs up once half the horizon is queued
+    set_stages(0);
+    assert(!sim_timing_port_backlogged(5));
+    assert(!sim_timing_port_backlogged(MAX_PORTS));
+    assert(submit(5, PORT_SPEED_10M, 2, 8, FULL_FRAME) == 8);
+    assert(sim_timing_port_backlogged(5));
+    assert(sim_timing_get_port_stats(5, &stats) == STATUS_SUCCESS);
+    assert(stats.pending > 0);
+
+    printf(TEST_PASSED, "test_sim_timing_pipeline");
+}
+
+int main() {
+    sim_timing_port_stats_t stats;
+
+    printf("Running sim timing unit tests...\n");
+
+    assert(packet_init() == STATUS_SUCCESS);
+    assert(sim_timing_enable(true) == STATUS_NOT_INITIALIZED);
+    assert(sim_timing_get_port_stats(0, &stats) == STATUS_NOT_INITIALIZED);
+    assert(sim_timing_init(NULL) == STATUS_INVALID_PARAMETER);
+    assert(sim_timing_init(release) == STATUS_SUCCESS);
+
+    test_sim_timing_config();
+    test_sim_timing_serialization();
+    test_sim_timing_pipeline();
+
+    // Packets still scheduled are freed, not sent
+    assert(sim_timing_shutdown() == STATUS_SUCCESS);
+    assert(sim_timing_shutdown() == STATUS_NOT_INITIALIZED);
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All sim timing tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,198 @@
+/**
+ * @file test_stats_export.c
+ * @brief Unit tests for the shared-memory statistics segment
+ *
+ * The reader side maps the segment by name, as an outside process would.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "../../include/management/stats_export.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define PORTS 4
+#define VLANS 16
+#define QUEUES 8
+#define UPDATES 20000
+
+static char g_name[64];
+
+typedef struct {
+    stats_export_t *exp;
+    bool done;
+} writer_arg_t;
+
+/* Map the segment read-only, as a reader in another process does */
+static const stats_export_header_t *map_segment(size_t *size) {
+    stats_export_header_t hdr;
+    void *map;
+    int fd = shm_open(g_name, O_RDONLY, 0);
+
+    assert(fd >= 0);
+    assert(read(fd, &hdr, sizeof(hdr)) == (ssize_t)sizeof(hdr));
+    map = mmap(NULL, hdr.total_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    assert(map != MAP_FAILED);
+    *size = hdr.total_size;
+    return (const stats_export_header_t *)map;
+}
+
+/* Every field of port 1 holds the update number */
+static void *write_updates(void *arg) {
+    writer_arg_t *w = (writer_arg_t *)arg;
+    stats_export_port_t *port = stats_export_port(w->exp, 1);
+
+    for (uint64_t n = 1; n <= UPDATES; n++) {
+        uint64_t *fields = (uint64_t *)port;
+        for (size_t i = 0; i < sizeof(*port) / sizeof(uint64_t); i++) {
+            fields[i] = n;
+        }
+        stats_export_publish(w->exp);
+    }
+    __atomic_store_n(&w->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+void test_stats_export_layout() {
+    stats_export_t *exp;
+    const stats_export_header_t *hdr;
+    size_t size;
+
+    assert(stats_export_create(g_name, 0, VLANS, QUEUES, &exp) == STATUS_INVALID_PARAMETER);
+    assert(stats_export_create("no-slash", PORTS, VLANS, QUEUES, &exp) == STATUS_INVALID_PARAMETER);
+    assert(stats_export_create(g_name, PORTS, VLANS, QUEUES, NULL) == STATUS_INVALID_PARAMETER);
+
+    assert(stats_export_create(g_name, PORTS, VLANS, QUEUES, &exp) == STATUS_SUCCESS);
+    hdr = map_segment(&size);
+
+    // A reader learns the layout from the header alone
+    assert(hdr->magic == STATS_EXPORT_MAGIC);
+    assert(hdr->version_major == STATS_EXPORT_VERSION_MAJOR);
+    assert(hdr->header_size == sizeof(stats_export_header_t));
+    assert(hdr->writer_pid == (uint32_t)getpid());
+    assert(hdr->port_count == PORTS && hdr->vlan_count == VLANS && hdr->queues_per_port == QUEUES);
+    assert(hdr->port_record_size == sizeof(stats_export_port_t));
+    assert(hdr->queue_record_size == sizeof(stats_export_queue_t));
+
+    // Tables are on cache lines of their own, in order, within the segment
+    assert(hdr->port_offset % 64 == 0 && hdr->vlan_offset % 64 == 0);
+    assert(hdr->queue_offset % 64 == 0 && hdr->routing_offset % 64 == 0);
+    assert(hdr->port_offset >= sizeof(stats_export_header_t));
+    assert(hdr->vlan_offset >= hdr->port_offset + PORTS * sizeof(stats_export_port_t));
+    assert(hdr->queue_offset >= hdr->vlan_offset + VLANS * sizeof(stats_export_vlan_t));
+    assert(hdr->routing_offset >= hdr->queue_offset + PORTS * QUEUES * sizeof(stats_export_queue_t));
+    assert(hdr->total_size == size && hdr->routing_offset + sizeof(stats_export_routing_t) <= size);
+
+    // Staging records stop at the table ends
+    assert(stats_export_port(exp, PORTS) == NULL);
+    assert(stats_export_vlan(exp, VLANS) == NULL);
+    assert(stats_export_queue(exp, PORTS * QUEUES) == NULL);
+    assert(stats_export_queue(exp, PORTS * QUEUES - 1) != NULL);
+
+    munmap((void *)hdr, size);
+    stats_export_destroy(exp);
+    stats_export_destroy(NULL);
+
+    // The segment goes with the writer
+    assert(shm_open(g_name, O_RDONLY, 0) < 0);
+
+    printf(TEST_PASSED, "test_stats_export_layout");
+}
+
+void test_stats_export_publish() {
+    stats_export_t *exp;
+    const stats_export_header_t *hdr;
+    stats_export_port_t port;
+    stats_export_vlan_t vlan;
+    stats_export_queue_t queue;
+    stats_export_routing_t routing;
+    size_t size;
+
+    assert(stats_export_create(g_name, PORTS, VLANS, QUEUES, &exp) == STATUS_SUCCESS);
+    hdr = map_segment(&size);
+    assert(hdr->sequence == 0 && hdr->update_count == 0);
+
+    // Staged counters stay out of sight until published
+    stats_export_port(exp, 2)->rx_packets = 100;
+    stats_export_vlan(exp, 10)->storm_dropped_packets = 7;
+    stats_export_queue(exp, 2 * QUEUES + 3)->max_depth = 55;
+    stats_export_routing(exp)->arp_replies = 9;
+    assert(stats_export_read(hdr, hdr->port_offset + 2 * hdr->port_record_size, sizeof(port), &port));
+    assert(port.rx_packets == 0);
+
+    stats_export_publish(exp);
+    assert(hdr->sequence == 2 && hdr->update_count == 1 && hdr->update_time_ns > 0);
+    assert(stats_export_read(hdr, hdr->port_offset + 2 * hdr->port_record_size, sizeof(port), &port));
+    assert(port.rx_packets == 100);
+    assert(stats_export_read(hdr, hdr->vlan_offset + 10 * hdr->vlan_record_size, sizeof(vlan), &vlan));
+    assert(vlan.storm_dropped_packets == 7);
+    assert(stats_export_read(hdr, hdr->queue_offset + (2 * QUEUES + 3) * hdr->queue_record_size,
+                             sizeof(queue), &queue));
+    assert(queue.max_depth == 55);
+    assert(stats_export_read(hdr, hdr->routing_offset, sizeof(routing), &routing));
+    assert(routing.arp_replies == 9);
+
+    // Ranges past the end are refused
+    assert(!stats_export_read(hdr, size, 1, &port));
+    assert(!stats_export_read(hdr, size - 8, sizeof(port), &port));
+
+    munmap((void *)hdr, size);
+    stats_export_destroy(exp);
+    printf(TEST_PASSED, "test_stats_export_publish");
+}
+
+void test_stats_export_consistent() {
+    writer_arg_t writer = { .done = false };
+    const stats_export_header_t *hdr;
+    stats_export_port_t port;
+    pthread_t thread;
+    uint64_t reads = 0;
+    uint64_t last = 0;
+    size_t size;
+
+    assert(stats_export_create(g_name, PORTS, VLANS, QUEUES, &writer.exp) == STATUS_SUCCESS);
+    hdr = map_segment(&size);
+
+    // No copy mixes two updates, and updates are seen in order; a writer done first still leaves one read
+    assert(pthread_create(&thread, NULL, write_updates, &writer) == 0);
+    do {
+        const uint64_t *fields = (const uint64_t *)&port;
+
+        assert(stats_export_read(hdr, hdr->port_offset + hdr->port_record_size, sizeof(port), &port));
+        for (size_t i = 1; i < sizeof(port) / sizeof(uint64_t); i++) {
+            assert(fields[i] == fields[0]);
+        }
+        assert(fields[0] >= last);
+        last = fields[0];
+        reads++;
+    } while (!__atomic_load_n(&writer.done, __ATOMIC_ACQUIRE));
+    assert(pthread_join(thread, NULL) == 0);
+    assert(reads > 0);
+    assert(hdr->update_count == UPDATES && hdr->sequence == 2ULL * UPDATES);
+
+    munmap((void *)hdr, size);
+    stats_export_destroy(writer.exp);
+    printf(TEST_PASSED, "test_stats_export_consistent");
+}
+
+int main() {
+    printf("Running stats export unit tests...\n");
+
+    snprintf(g_name, sizeof(g_name), "/test_stats_export_%d", (int)getpid());
+
+    test_stats_export_layout();
+    test_stats_export_publish();
+    test_stats_export_consistent();
+
+    printf("All stats export tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,315 @@
+/**
+ * @file test_stats_history.c
+ * @brief Unit tests for the counter time series and their rates
+ *
+ * The history stamps samples with the wall clock, so expected rates are
+ * worked out from the sample times the history itself reports.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "../../include/management/stats_history.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define PORTS 4
+#define PORT_WORDS 6
+#define QUEUES 8
+#define QUEUE_WORDS 2
+#define DEPTH 4
+#define RX_BYTES 2
+#define TX_BYTES 3
+#define GAP_US 2000
+
+static const uint32_t g_counts[TELEMETRY_OBJ_COUNT] = {
+    [TELEMETRY_OBJ_PORT] = PORTS, [TELEMETRY_OBJ_VLAN] = 4096, [TELEMETRY_OBJ_QUEUE] = QUEUES,
+};
+static const uint32_t g_words[TELEMETRY_OBJ_COUNT] = {
+    [TELEMETRY_OBJ_PORT] = PORT_WORDS, [TELEMETRY_OBJ_VLAN] = 8, [TELEMETRY_OBJ_QUEUE] = QUEUE_WORDS,
+};
+
+static char g_name[64];
+
+static stats_history_config_t make_config(uint32_t depth, uint8_t ewma_pct) {
+    stats_history_config_t config;
+
+    memset(&config, 0, sizeof(config));
+    config.interval_ms = 1000;
+    config.depth = depth;
+    config.objects = TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_PORT) | TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_QUEUE);
+    config.ewma_pct = ewma_pct;
+    return config;
+}
+
+/* One sample: every counter of port p is base * (p + 1) + counter number */
+static void sample_ports(stats_history_t *hist, uint64_t base, uint32_t ports) {
+    uint64_t counters[PORT_WORDS];
+
+    usleep(GAP_US);
+    stats_history_begin(hist);
+    for (uint32_t p = 0; p < ports; p++) {
+        for (uint32_t c = 0; c < PORT_WORDS; c++) {
+            counters[c] = base * (p + 1) + c;
+        }
+        stats_history_record(hist, TELEMETRY_OBJ_PORT, p, counters);
+    }
+    stats_history_end(hist);
+}
+
+/* Rate the history should report between its two newest samples */
+static double expected_rate(const stats_history_header_t *hdr, uint32_t port, uint32_t counter) {
+    uint64_t values[2], times[2];
+    uint32_t count;
+
+    assert(stats_history_get_series(hdr, TELEMETRY_OBJ_PORT, port, counter, values, times, 2, &count) ==
+           STATUS_SUCCESS);
+    assert(count == 2 && times[1] > times[0]);
+    return values[1] < values[0] ? 0 : (double)(values[1] - values[0]) * 1e9 / (double)(times[1] - times[0]);
+}
+
+static bool close_to(double a, double b) {
+    return fabs(a - b) <= 1e-9 * fmax(fabs(a), fabs(b));
+}
+
+void test_stats_history_create() {
+    stats_history_config_t config = make_config(0, 0);
+    const stats_history_header_t *hdr;
+    stats_history_t *hist;
+
+    assert(stats_history_create(NULL, g_counts, g_words, &hist) == STATUS_INVALID_PARAMETER);
+    config.interval_ms = 0;
+    assert(stats_history_create(&config, g_counts, g_words, &hist) == STATUS_INVALID_PARAMETER);
+    config = make_config(0, 101);
+    assert(stats_history_create(&config, g_counts, g_words, &hist) == STATUS_INVALID_PARAMETER);
+    config = make_config(0, 0);
+    config.objects = 0;
+    assert(stats_history_create(&config, g_counts, g_words, &hist) == STATUS_INVALID_PARAMETER);
+    config = make_config(0, 0);
+    config.name = "no_slash";
+    assert(stats_history_create(&config, g_counts, g_words, &hist) == STATUS_INVALID_PARAMETER);
+
+    // Defaults fill in, and types not sampled take no room
+    config = make_config(0, 0);
+    assert(stats_history_create(&config, g_counts, g_words, &hist) == STATUS_SUCCESS);
+    assert(stats_history_objects(hist) == config.objects);
+    hdr = stats_history_header(hist);
+    assert(hdr->magic == STATS_HISTORY_MAGIC && hdr->version_major == STATS_HISTORY_VERSION_MAJOR);
+    assert(hdr->header_size == sizeof(stats_history_header_t) && hdr->writer_pid == (uint32_t)getpid());
+    assert(hdr->depth == STATS_HISTORY_DEFAULT_DEPTH && hdr->slots == hdr->depth + 1);
+    assert(hdr->ewma_pct == STATS_HISTORY_DEFAULT_EWMA_PCT && hdr->interval_ms == 1000);
+    assert(hdr->samples == 0 && hdr->update_count == 0 && hdr->sequence == 0);
+    assert(hdr->count[TELEMETRY_OBJ_PORT] == PORTS && hdr->words[TELEMETRY_OBJ_PORT] == PORT_WORDS);
+    assert(hdr->count[TELEMETRY_OBJ_VLAN] == 0 && hdr->words[TELEMETRY_OBJ_VLAN] == 0);
+    for (int t = 0; t < TELEMETRY_OBJ_COUNT; t++) {
+        assert(hdr->sample_offset[t] % 64 == 0 && hdr->rate_offset[t] % 64 == 0);
+        assert(hdr->rate_offset[t] + (uint64_t)hdr->count[t] * hdr->words[t] * sizeof(stats_history_rate_t) <=
+               hdr->total_size);
+    }
+    assert(hdr->time_offset >= sizeof(stats_history_header_t) && hdr->speed_offset % 64 == 0);
+    stats_history_destroy(hist);
+    stats_history_destroy(NULL);
+
+    printf(TEST_PASSED, "test_stats_history_create");
+}
+
+void test_stats_history_series() {
+    stats_history_config_t config = make_config(DEPTH, 0);
+    const stats_history_header_t *hdr;
+    uint64_t values[DEPTH + 2], times[DEPTH + 2];
+    stats_history_t *hist;
+    uint32_t count;
+
+    assert(stats_history_create(&config, g_counts, g_words, &hist) == STATUS_SUCCESS);
+    hdr = stats_history_header(hist);
+
+    // Empty at first
+    assert(stats_history_get_series(hdr, TELEMETRY_OBJ_PORT, 1, 0, values, times, DEPTH, &count) ==
+           STATUS_SUCCESS);
+    assert(count == 0);
+
+    // Past the depth the oldest samples drop out, and the rest come oldest first
+    for (uint64_t s = 1; s <= DEPTH + 2; s++) {
+        sample_ports(hist, s * 100, PORTS);
+    }
+    assert(hdr->samples == DEPTH && hdr->update_count == DEPTH + 2 && hdr->sequence == 2 * (DEPTH + 2));
+    assert(stats_history_get_series(hdr, TELEMETRY_OBJ_PORT, 1, 4, values, times, DEPTH + 2, &count) ==
+           STATUS_SUCCESS);
+    assert(count == DEPTH);
+    for (uint32_t i = 0; i < count; i++) {
+        assert(values[i] == (i + 3) * 100 * 2 + 4);
+        assert(i == 0 || times[i] - times[i - 1] >= GAP_US * 1000ULL);
+    }
+    assert(times[count - 1] == hdr->update_time_ns);
+
+    // A shorter read gives the newest ones, times optional
+    assert(stats_history_get_series(hdr, TELEMETRY_OBJ_PORT, 1, 4, values, NULL, 2, &count) == STATUS_SUCCESS);
+    assert(count == 2 && values[0] == 5 * 100 * 2 + 4 && values[1] == 6 * 100 * 2 + 4);
+
+    // Objects not recorded repeat their last sample; never recorded, they read 0
+    assert(stats_history_get_series(hdr, TELEMETRY_OBJ_QUEUE, 0, 1, values, NULL, DEPTH, &count) ==
+           STATUS_SUCCESS);
+    assert(count == DEPTH && values[0] == 0 && values[DEPTH - 1] == 0);
+    sample_ports(hist, 1000, 1);
+    assert(stats_history_get_series(hdr, TELEMETRY_OBJ_PORT, 2, 0, values, NULL, 2, &count) == STATUS_SUCCESS);
+    assert(values[0] == 6 * 100 * 3 && values[1] == values[0]);
+
+    // Out of range
+    assert(stats_history_get_series(hdr, TELEMETRY_OBJ_PORT, PORTS, 0, values, NULL, 1, &count) ==
+           STATUS_INVALID_PARAMETER);
+    assert(stats_history_get_series(hdr, TELEMETRY_OBJ_PORT, 0, PORT_WORDS, values, NULL, 1, &count) ==
+           STATUS_INVALID_PARAMETER);
+    assert(stats_history_get_series(hdr, TELEMETRY_OBJ_VLAN, 0, 0, values, NULL, 1, &count) ==
+           STATUS_INVALID_PARAMETER);
+    stats_history_destroy(hist);
+
+    printf(TEST_PASSED, "test_stats_history_series");
+}
+
+void test_stats_history_rates() {
+    stats_history_config_t config = make_config(DEPTH, 50);
+    stats_history_rate_t rate, rates[PORT_WORDS + 2];
+    const stats_history_header_t *hdr;
+    stats_history_t *hist;
+    double first, second;
+    uint32_t count;
+
+    assert(stats_history_create(&config, g_counts, g_words, &hist) == STATUS_SUCCESS);
+    hdr = stats_history_header(hist);
+
+    // One sample has no rate yet
+    sample_ports(hist, 1000, PORTS);
+    assert(stats_history_get_rate(hdr, TELEMETRY_OBJ_PORT, 0, RX_BYTES, &rate) == STATUS_SUCCESS);
+    assert(rate.rate == 0 && rate.ewma == 0 && rate.peak == 0);
+
+    // The second starts the average at the first rate
+    sample_ports(hist, 5000, PORTS);
+    first = expected_rate(hdr, 1, RX_BYTES);
+    assert(first > 0);
+    assert(stats_history_get_rate(hdr, TELEMETRY_OBJ_PORT, 1, RX_BYTES, &rate) == STATUS_SUCCESS);
+    assert(close_to(rate.rate, first) && close_to(rate.ewma, first) && close_to(rate.peak, first));
+
+    // Later ones move it by the configured weight
+    sample_ports(hist, 6000, PORTS);
+    second = expected_rate(hdr, 1, RX_BYTES);
+    assert(stats_history_get_rate(hdr, TELEMETRY_OBJ_PORT, 1, RX_BYTES, &rate) == STATUS_SUCCESS);
+    assert(close_to(rate.rate, second));
+    assert(close_to(rate.ewma, first + 0.5 * (second - first)));
+    assert(close_to(rate.peak, fmax(first, second)));
+
+    // A counter that went down, as after a clear, reads 0 and leaves the peak
+    sample_ports(hist, 10, PORTS);
+    assert(stats_history_get_rates(hdr, TELEMETRY_OBJ_PORT, 1, rates, PORT_WORDS + 2, &count) == STATUS_SUCCESS);
+    assert(count == PORT_WORDS);
+    for (uint32_t c = 0; c < count; c++) {
+        assert(rates[c].rate == 0 && rates[c].peak > 0);
+    }
+    assert(close_to(rates[RX_BYTES].peak, fmax(first, second)));
+    assert(stats_history_get_rates(hdr, TELEMETRY_OBJ_PORT, 1, rates, 2, &count) == STATUS_SUCCESS);
+    assert(count == 2);
+
+    assert(stats_history_get_rate(hdr, TELEMETRY_OBJ_PORT, 1, PORT_WORDS, &rate) == STATUS_INVALID_PARAMETER);
+    assert(stats_history_get_rate(hdr, TELEMETRY_OBJ_VLAN, 0, 0, &rate) == STATUS_INVALID_PARAMETER);
+    assert(stats_history_get_rates(hdr, TELEMETRY_OBJ_PORT, PORTS, rates, 1, &count) == STATUS_INVALID_PARAMETER);
+    stats_history_destroy(hist);
+
+    printf(TEST_PASSED, "test_stats_history_rates");
+}
+
+void test_stats_history_utilization() {
+    stats_history_config_t config = make_config(DEPTH, 0);
+    stats_history_utilization_t util;
+    const stats_history_header_t *hdr;
+    stats_history_t *hist;
+    double rx, tx;
+
+    assert(stats_history_create(&config, g_counts, g_words, &hist) == STATUS_SUCCESS);
+    hdr = stats_history_header(hist);
+    stats_history_set_port_speed(hist, 0, 1000);
+    stats_history_set_port_speed(hist, PORTS, 1000);
+    sample_ports(hist, 100000, PORTS);
+    sample_ports(hist, 200000, PORTS);
+
+    // Byte rates become bits, and a share of the speed when it is known
+    rx = expected_rate(hdr, 0, RX_BYTES) * 8;
+    tx = expected_rate(hdr, 0, TX_BYTES) * 8;
+    assert(stats_history_port_utilization(hdr, 0, &util) == STATUS_SUCCESS);
+    assert(util.speed_mbps == 1000);
+    assert(close_to(util.rx_bps, rx) && close_to(util.tx_bps, tx));
+    assert(close_to(util.rx_avg_bps, rx) && close_to(util.tx_peak_bps, tx));
+    assert(close_to(util.rx_percent, rx * 100 / 1e9) && close_to(util.tx_percent, tx * 100 / 1e9));
+    assert(stats_history_port_utilization(hdr, 1, &util) == STATUS_SUCCESS);
+    assert(util.speed_mbps == 0 && util.rx_bps > 0 && util.rx_percent == 0);
+
+    assert(stats_history_port_utilization(hdr, PORTS, &util) == STATUS_INVALID_PARAMETER);
+    assert(stats_history_port_utilization(hdr, 0, NULL) == STATUS_INVALID_PARAMETER);
+    stats_history_destroy(hist);
+
+    // Not when ports are not sampled
+    config.objects = TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_QUEUE);
+    assert(stats_history_create(&config, g_counts, g_words, &hist) == STATUS_SUCCESS);
+    assert(stats_history_port_utilization(stats_history_header(hist), 0, &util) == STATUS_INVALID_PARAMETER);
+    stats_history_destroy(hist);
+
+    printf(TEST_PASSED, "test_stats_history_utilization");
+}
+
+void test_stats_history_shared() {
+    stats_history_config_t config = make_config(DEPTH, 0);
+    stats_history_header_t copy;
+    const stats_history_header_t *hdr;
+    stats_history_t *hist;
+    uint32_t head, samples;
+    uint64_t value;
+    void *map;
+    int fd;
+
+    config.name = g_name;
+    assert(stats_history_create(&config, g_counts, g_words, &hist) == STATUS_SUCCESS);
+    sample_ports(hist, 100, PORTS);
+    sample_ports(hist, 200, PORTS);
+
+    // Another mapping of the segment sees the same samples
+    fd = shm_open(g_name, O_RDONLY, 0);
+    assert(fd >= 0);
+    map = mmap(NULL, stats_history_header(hist)->total_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    assert(map != MAP_FAILED);
+    hdr = (const stats_history_header_t *)map;
+    assert(stats_history_read(hdr, 0, sizeof(copy), &copy, &head, &samples));
+    assert(copy.magic == STATS_HISTORY_MAGIC && samples == 2 && head == 2 && copy.update_count == 2);
+    assert(stats_history_read(hdr, hdr->sample_offset[TELEMETRY_OBJ_PORT] +
+                                   ((size_t)3 * hdr->slots + head) * PORT_WORDS * sizeof(uint64_t),
+                              sizeof(value), &value, NULL, NULL));
+    assert(value == 200 * 4);
+    assert(!stats_history_read(hdr, hdr->total_size, 1, &value, NULL, NULL));
+    munmap(map, stats_history_header(hist)->total_size);
+
+    // Destroying it unlinks the segment
+    stats_history_destroy(hist);
+    assert(shm_open(g_name, O_RDONLY, 0) < 0);
+
+    printf(TEST_PASSED, "test_stats_history_shared");
+}
+
+int main() {
+    printf("Running stats history unit tests...\n");
+
+    snprintf(g_name, sizeof(g_name), "/test_stats_history_%d", (int)getpid());
+
+    test_stats_history_create();
+    test_stats_history_series();
+    test_stats_history_rates();
+    test_stats_history_utilization();
+    test_stats_history_shared();
+
+    printf("All stats history tests completed successfully.\n");
+    return 0;
+}
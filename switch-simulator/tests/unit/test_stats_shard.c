@@ -0,0 +1,156 @@
+/**
+ * @file test_stats_shard.c
+ * @brief Unit tests for per-thread sharded counters
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "../../include/common/stats_shard.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define WORDS 4
+#define THREADS 4
+#define COUNTS 100000
+
+static stats_shard_set_t *g_set;
+
+/* Count 1 into counter 0 and 2 into counter 1, COUNTS times */
+static void *count_thread(void *arg) {
+    (void)arg;
+
+    for (int i = 0; i < COUNTS; i++) {
+        uint64_t *counters = stats_shard_local(g_set);
+        stats_shard_add(&counters[0], 1);
+        stats_shard_add(&counters[1], 2);
+    }
+    return NULL;
+}
+
+static void run_threads(int count) {
+    pthread_t threads[THREADS];
+
+    for (int i = 0; i < count; i++) {
+        assert(pthread_create(&threads[i], NULL, count_thread, NULL) == 0);
+    }
+    for (int i = 0; i < count; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+}
+
+static uint64_t fold_one(stats_shard_set_t *set, size_t counter) {
+    uint64_t value;
+
+    stats_shard_fold(set, counter, 1, &value);
+    return value;
+}
+
+void test_stats_shard_create() {
+    stats_shard_set_t *sets[STATS_SHARD_MAX_SETS];
+    stats_shard_set_t *extra;
+
+    assert(stats_shard_create(0, &extra) == STATUS_INVALID_PARAMETER);
+    assert(stats_shard_create(WORDS, NULL) == STATUS_INVALID_PARAMETER);
+
+    for (int i = 0; i < STATS_SHARD_MAX_SETS; i++) {
+        assert(stats_shard_create(WORDS, &sets[i]) == STATUS_SUCCESS);
+    }
+    assert(stats_shard_create(WORDS, &extra) == STATUS_RESOURCE_EXHAUSTED);
+
+    // A destroyed set frees its slot
+    stats_shard_destroy(sets[0]);
+    assert(stats_shard_create(WORDS, &sets[0]) == STATUS_SUCCESS);
+    for (int i = 0; i < STATS_SHARD_MAX_SETS; i++) {
+        stats_shard_destroy(sets[i]);
+    }
+    stats_shard_destroy(NULL);
+
+    printf(TEST_PASSED, "test_stats_shard_create");
+}
+
+void test_stats_shard_fold() {
+    uint64_t totals[WORDS];
+    uint64_t *local;
+
+    assert(stats_shard_create(WORDS, &g_set) == STATUS_SUCCESS);
+    stats_shard_fold(g_set, 0, WORDS, totals);
+    for (int i = 0; i < WORDS; i++) {
+        assert(totals[i] == 0);
+    }
+
+    // The calling thread keeps the same shard
+    local = stats_shard_local(g_set);
+    assert(stats_shard_local(g_set) == local);
+    stats_shard_add(&local[3], 7);
+
+    // Every thread's counts add up, none lost
+    run_threads(THREADS);
+    stats_shard_fold(g_set, 0, WORDS, totals);
+    assert(totals[0] == (uint64_t)THREADS * COUNTS);
+    assert(totals[1] == (uint64_t)THREADS * COUNTS * 2);
+    assert(totals[2] == 0 && totals[3] == 7);
+
+    // A range of counters folds by itself
+    stats_shard_fold(g_set, 1, 2, totals);
+    assert(totals[0] == (uint64_t)THREADS * COUNTS * 2 && totals[1] == 0);
+
+    // Exited threads' shards are kept and reused by new threads
+    run_threads(1);
+    assert(fold_one(g_set, 0) == (uint64_t)(THREADS + 1) * COUNTS);
+
+    stats_shard_destroy(g_set);
+    printf(TEST_PASSED, "test_stats_shard_fold");
+}
+
+void test_stats_shard_clear() {
+    uint64_t *local;
+
+    assert(stats_shard_create(WORDS, &g_set) == STATUS_SUCCESS);
+    run_threads(2);
+    local = stats_shard_local(g_set);
+    stats_shard_add(&local[2], 5);
+
+    // Clearing one counter leaves the others
+    stats_shard_clear(g_set, 0, 1);
+    assert(fold_one(g_set, 0) == 0);
+    assert(fold_one(g_set, 1) == 2ULL * COUNTS * 2);
+    assert(fold_one(g_set, 2) == 5);
+
+    // Counting goes on from the cleared value
+    run_threads(1);
+    stats_shard_add(&local[2], 1);
+    assert(fold_one(g_set, 0) == COUNTS);
+    assert(fold_one(g_set, 2) == 6);
+
+    stats_shard_clear(g_set, 0, WORDS);
+    for (int i = 0; i < WORDS; i++) {
+        assert(fold_one(g_set, (size_t)i) == 0);
+    }
+    stats_shard_destroy(g_set);
+
+    // A new set in the same slot starts the calling thread on a fresh shard
+    assert(stats_shard_create(WORDS, &g_set) == STATUS_SUCCESS);
+    local = stats_shard_local(g_set);
+    assert(local[2] == 0);
+    stats_shard_add(&local[2], 1);
+    assert(fold_one(g_set, 2) == 1);
+    stats_shard_destroy(g_set);
+
+    printf(TEST_PASSED, "test_stats_shard_clear");
+}
+
+int main() {
+    printf("Running stats shard unit tests...\n");
+
+    test_stats_shard_create();
+    test_stats_shard_fold();
+    test_stats_shard_clear();
+
+    printf("All stats shard tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,234 @@
+/**
+ * @file test_stats_threshold.c
+ * @brief Unit tests for statistics threshold monitoring
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "../../include/management/stats_threshold.h"
+#include "../../include/management/stats_export.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define PORTS 4
+#define VLANS 128
+#define QUEUES 8
+#define PORT_WORDS (sizeof(stats_export_port_t) / sizeof(uint64_t))
+#define VLAN_WORDS (sizeof(stats_export_vlan_t) / sizeof(uint64_t))
+#define QUEUE_WORDS (sizeof(stats_export_queue_t) / sizeof(uint64_t))
+#define ROUTING_WORDS (sizeof(stats_export_routing_t) / sizeof(uint64_t))
+#define WAIT_POLLS 2000
+
+static const uint32_t g_counts[TELEMETRY_OBJ_COUNT] = { PORTS, VLANS, PORTS * QUEUES, 1, 0 };
+static const uint32_t g_words[TELEMETRY_OBJ_COUNT] = { PORT_WORDS, VLAN_WORDS, QUEUE_WORDS, ROUTING_WORDS, 0 };
+
+static uint32_t g_fired[4];
+static bool g_block;
+
+static void count_event(void *user_data) {
+    __atomic_fetch_add((uint32_t *)user_data, 1, __ATOMIC_RELAXED);
+}
+
+/* Holds the dispatcher until released, so that events pile up */
+static void blocking_event(void *user_data) {
+    while (__atomic_load_n(&g_block, __ATOMIC_ACQUIRE)) {
+        usleep(100);
+    }
+    count_event(user_data);
+}
+
+static uint32_t fired(int n) {
+    return __atomic_load_n(&g_fired[n], __ATOMIC_RELAXED);
+}
+
+/* Callbacks run on the dispatcher thread; wait for them to arrive */
+static void wait_fired(int n, uint32_t expected) {
+    for (int i = 0; i < WAIT_POLLS && fired(n) < expected; i++) {
+        usleep(1000);
+    }
+    assert(fired(n) == expected);
+}
+
+/* One interval in which port 0 has rx_packets and VLAN vid has tx_bytes */
+static uint32_t interval(stats_threshold_engine_t *engine, uint64_t rx_packets,
+                         uint32_t vid, uint64_t tx_bytes) {
+    stats_export_port_t port;
+    stats_export_vlan_t vlan;
+
+    memset(&port, 0, sizeof(port));
+    memset(&vlan, 0, sizeof(vlan));
+    port.rx_packets = rx_packets;
+    vlan.tx_bytes = tx_bytes;
+
+    stats_threshold_begin(engine);
+    stats_threshold_record(engine, TELEMETRY_OBJ_PORT, 0, (const uint64_t *)&port);
+    if (vid) {
+        stats_threshold_record(engine, TELEMETRY_OBJ_VLAN, vid, (const uint64_t *)&vlan);
+    }
+    return stats_threshold_evaluate(engine);
+}
+
+void test_stats_threshold_parse() {
+    stats_threshold_t t;
+
+    assert(stats_threshold_parse("port_rx_packets_1", QUEUES, &t) == STATUS_SUCCESS);
+    assert(t.object == TELEMETRY_OBJ_PORT && t.index == 1 && t.counter == 0);
+    assert(stats_threshold_parse("vlan_tx_bytes_100", QUEUES, &t) == STATUS_SUCCESS);
+    assert(t.object == TELEMETRY_OBJ_VLAN && t.index == 100 && t.counter == 3);
+    assert(stats_threshold_parse("queue_dropped_3_7", QUEUES, &t) == STATUS_SUCCESS);
+    assert(t.object == TELEMETRY_OBJ_QUEUE && t.index == 3 * QUEUES + 7 && t.counter == 2);
+    assert(stats_threshold_parse("routing_arp_requests", QUEUES, &t) == STATUS_SUCCESS);
+    assert(t.object == TELEMETRY_OBJ_ROUTING && t.index == 0 && t.counter == 3);
+    assert(stats_threshold_parse("int_depth_max_0", QUEUES, &t) == STATUS_SUCCESS);
+    assert(t.object == TELEMETRY_OBJ_INT && t.counter == 6);
+
+    // Counter names share prefixes; only a whole name matches
+    assert(stats_threshold_parse("vlan_storm_dropped_bytes_5", QUEUES, &t) == STATUS_SUCCESS);
+    assert(t.counter == 5 && t.index == 5);
+
+    assert(stats_threshold_parse("port_rx_packet_1", QUEUES, &t) == STATUS_INVALID_PARAMETER);
+    assert(stats_threshold_parse("port_rx_packets", QUEUES, &t) == STATUS_INVALID_PARAMETER);
+    assert(stats_threshold_parse("port_rx_packets_1x", QUEUES, &t) == STATUS_INVALID_PARAMETER);
+    assert(stats_threshold_parse("queue_dropped_3_8", QUEUES, &t) == STATUS_INVALID_PARAMETER);
+    assert(stats_threshold_parse("routing_arp_requests_0", QUEUES, &t) == STATUS_INVALID_PARAMETER);
+    assert(stats_threshold_parse("port_rx_packets_99999999999", QUEUES, &t) == STATUS_INVALID_PARAMETER);
+    assert(stats_threshold_parse("fan_speed_1", QUEUES, &t) == STATUS_INVALID_PARAMETER);
+    assert(stats_threshold_parse(NULL, QUEUES, &t) == STATUS_INVALID_PARAMETER);
+
+    printf(TEST_PASSED, "test_stats_threshold_parse");
+}
+
+void test_stats_threshold_value() {
+    stats_threshold_engine_t *engine;
+    stats_threshold_t t = { .kind = STATS_THRESHOLD_VALUE, .threshold = 100,
+                            .callback = count_event, .user_data = &g_fired[0] };
+    uint32_t id;
+
+    memset(g_fired, 0, sizeof(g_fired));
+    assert(stats_threshold_engine_create(g_counts, g_words, &engine) == STATUS_SUCCESS);
+    assert(stats_threshold_objects(engine) == 0);
+
+    assert(stats_threshold_parse("port_rx_packets_0", QUEUES, &t) == STATUS_SUCCESS);
+    assert(stats_threshold_add(engine, &t, &id) == STATUS_SUCCESS);
+    t.user_data = &g_fired[1];
+    assert(stats_threshold_parse("vlan_tx_bytes_10", QUEUES, &t) == STATUS_SUCCESS);
+    assert(stats_threshold_add(engine, &t, NULL) == STATUS_SUCCESS);
+    assert(stats_threshold_objects(engine) ==
+           (TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_PORT) | TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_VLAN)));
+
+    // Definitions outside the engine's tables are refused
+    t.index = VLANS;
+    assert(stats_threshold_add(engine, &t, NULL) == STATUS_INVALID_PARAMETER);
+    t.index = 10;
+    t.counter = VLAN_WORDS;
+    assert(stats_threshold_add(engine, &t, NULL) == STATUS_INVALID_PARAMETER);
+    t.counter = 0;
+    t.callback = NULL;
+    assert(stats_threshold_add(engine, &t, NULL) == STATUS_INVALID_PARAMETER);
+
+    // At the limit is not over it
+    assert(interval(engine, 100, 10, 100) == 0);
+
+    // Crossing fires once, staying above does not fire again
+    assert(interval(engine, 101, 10, 50) == 1);
+    wait_fired(0, 1);
+    assert(interval(engine, 500, 10, 50) == 0);
+
+    // Falling back re-arms; the next crossing fires again
+    assert(interval(engine, 10, 10, 50) == 0);
+    assert(interval(engine, 200, 10, 50) == 1);
+    wait_fired(0, 2);
+
+    // A VLAN not recorded in an interval reads as zero
+    assert(interval(engine, 200, 10, 1000) == 1);
+    wait_fired(1, 1);
+    assert(interval(engine, 200, 0, 0) == 0);
+    assert(interval(engine, 200, 10, 1000) == 1);
+    wait_fired(1, 2);
+
+    // A removed threshold is gone
+    assert(stats_threshold_remove(engine, id) == STATUS_SUCCESS);
+    assert(stats_threshold_remove(engine, id) == STATUS_NOT_FOUND);
+    assert(stats_threshold_objects(engine) == TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_VLAN));
+    assert(interval(engine, 0, 10, 0) == 0);
+    assert(interval(engine, 1000, 10, 0) == 0);
+    assert(fired(0) == 2);
+
+    stats_threshold_engine_destroy(engine);
+    stats_threshold_engine_destroy(NULL);
+    printf(TEST_PASSED, "test_stats_threshold_value");
+}
+
+void test_stats_threshold_rate() {
+    stats_threshold_engine_t *engine;
+    stats_threshold_t t = { .kind = STATS_THRESHOLD_RATE, .threshold = 1000,
+                            .callback = count_event, .user_data = &g_fired[2] };
+
+    memset(g_fired, 0, sizeof(g_fired));
+    assert(stats_threshold_engine_create(g_counts, g_words, &engine) == STATUS_SUCCESS);
+    assert(stats_threshold_parse("port_rx_packets_0", QUEUES, &t) == STATUS_SUCCESS);
+    assert(stats_threshold_add(engine, &t, NULL) == STATUS_SUCCESS);
+
+    // The first interval has nothing to take a rate against
+    assert(interval(engine, 1000000, 0, 0) == 0);
+
+    // A million more in a few milliseconds is well over 1000 per second
+    usleep(5000);
+    assert(interval(engine, 2000000, 0, 0) == 1);
+    wait_fired(2, 1);
+
+    // A standing counter has no rate, whatever its value
+    usleep(5000);
+    assert(interval(engine, 2000000, 0, 0) == 0);
+
+    // Nor does one that was cleared
+    usleep(5000);
+    assert(interval(engine, 0, 0, 0) == 0);
+    usleep(5000);
+    assert(interval(engine, 1000000, 0, 0) == 1);
+    wait_fired(2, 2);
+
+    stats_threshold_engine_destroy(engine);
+    printf(TEST_PASSED, "test_stats_threshold_rate");
+}
+
+void test_stats_threshold_dropped() {
+    const uint32_t extra = 76;
+    stats_threshold_engine_t *engine;
+    stats_threshold_t t = { .kind = STATS_THRESHOLD_VALUE, .threshold = 0,
+                            .callback = blocking_event, .user_data = &g_fired[3] };
+
+    memset(g_fired, 0, sizeof(g_fired));
+    assert(stats_threshold_engine_create(g_counts, g_words, &engine) == STATUS_SUCCESS);
+    assert(stats_threshold_parse("port_rx_packets_0", QUEUES, &t) == STATUS_SUCCESS);
+    for (uint32_t i = 0; i < STATS_THRESHOLD_EVENT_QUEUE + extra; i++) {
+        assert(stats_threshold_add(engine, &t, NULL) == STATUS_SUCCESS);
+    }
+
+    // Events past the queue are counted as dropped, not delivered late
+    __atomic_store_n(&g_block, true, __ATOMIC_RELEASE);
+    assert(interval(engine, 1, 0, 0) == STATS_THRESHOLD_EVENT_QUEUE + extra);
+    assert(stats_threshold_dropped_events(engine) == extra);
+    __atomic_store_n(&g_block, false, __ATOMIC_RELEASE);
+    wait_fired(3, STATS_THRESHOLD_EVENT_QUEUE);
+
+    stats_threshold_engine_destroy(engine);
+    printf(TEST_PASSED, "test_stats_threshold_dropped");
+}
+
+int main() {
+    printf("Running stats threshold unit tests...\n");
+
+    test_stats_threshold_parse();
+    test_stats_threshold_value();
+    test_stats_threshold_rate();
+    test_stats_threshold_dropped();
+
+    printf("All stats threshold tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,200 @@
+/**
+ * @file test_storm_control.c
+ * @brief Unit tests for flood storm control policers
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "../../include/l2/storm_control.h"
+#include "../../include/common/config.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define STORM_THREADS 4
+#define STORM_FRAMES_PER_THREAD 100000
+
+static uint8_t g_frame[1500];
+
+static void make_frame(packet_buffer_t *packet, const uint8_t dst[6], uint32_t size) {
+    memset(packet, 0, sizeof(*packet));
+    memset(g_frame, 0, sizeof(g_frame));
+    memcpy(g_frame, dst, 6);
+    packet->data = g_frame;
+    packet->size = size;
+}
+
+static const uint8_t g_bcast[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+static const uint8_t g_mcast[6] = { 0x01, 0x00, 0x5E, 0x00, 0x00, 0x01 };
+static const uint8_t g_ucast[6] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55 };
+
+void test_storm_classify() {
+    packet_buffer_t packet;
+
+    make_frame(&packet, g_bcast, 64);
+    assert(storm_control_classify(&packet) == STORM_TYPE_BROADCAST);
+    make_frame(&packet, g_mcast, 64);
+    assert(storm_control_classify(&packet) == STORM_TYPE_MULTICAST);
+    make_frame(&packet, g_ucast, 64);
+    assert(storm_control_classify(&packet) == STORM_TYPE_UNKNOWN_UNICAST);
+
+    printf(TEST_PASSED, "test_storm_classify");
+}
+
+void test_storm_port_packet_burst() {
+    storm_limit_t limit = { .pps = 10, .burst_packets = 5 };
+    storm_counters_t counters;
+    packet_buffer_t packet;
+    int admitted = 0;
+
+    make_frame(&packet, g_bcast, 64);
+
+    // Unlimited until configured
+    for (int i = 0; i < 100; i++) {
+        assert(storm_control_admit(1, 10, &packet));
+    }
+
+    assert(storm_control_set_port(1, STORM_TYPE_BROADCAST, &limit) == STATUS_SUCCESS);
+    for (int i = 0; i < 100; i++) {
+        admitted += storm_control_admit(1, 10, &packet);
+    }
+    assert(admitted == 5);
+
+    // Other classes and ports are not limited
+    make_frame(&packet, g_ucast, 64);
+    assert(storm_control_admit(1, 10, &packet));
+    make_frame(&packet, g_bcast, 64);
+    assert(storm_control_admit(2, 10, &packet));
+
+    assert(storm_control_get_port_counters(1, &counters) == STATUS_SUCCESS);
+    assert(counters.dropped_packets == 95 && counters.dropped_bytes == 95 * 64);
+    assert(storm_control_get_vlan_counters(10, &counters) == STATUS_SUCCESS);
+    assert(counters.dropped_packets == 95);
+
+    assert(storm_control_set_port(1, STORM_TYPE_BROADCAST, NULL) == STATUS_SUCCESS);
+    assert(storm_control_admit(1, 10, &packet));
+
+    printf(TEST_PASSED, "test_storm_port_packet_burst");
+}
+
+void test_storm_vlan_byte_limit() {
+    storm_limit_t limit = { .bps = 1000, .burst_bytes = 3000 };
+    storm_counters_t counters;
+    packet_buffer_t packet;
+    int admitted = 0;
+
+    assert(storm_control_clear_vlan_counters(20) == STATUS_SUCCESS);
+    assert(storm_control_set_vlan(20, STORM_TYPE_UNKNOWN_UNICAST, &limit) == STATUS_SUCCESS);
+
+    make_frame(&packet, g_ucast, 1000);
+    for (int i = 0; i < 10; i++) {
+        admitted += storm_control_admit(3, 20, &packet);
+    }
+    assert(admitted == 3);
+
+    assert(storm_control_get_vlan_counters(20, &counters) == STATUS_SUCCESS);
+    assert(counters.dropped_packets == 7 && counters.dropped_bytes == 7000);
+    assert(storm_control_clear_vlan_counters(20) == STATUS_SUCCESS);
+    assert(storm_control_get_vlan_counters(20, &counters) == STATUS_SUCCESS);
+    assert(counters.dropped_packets == 0);
+
+    assert(storm_control_set_vlan(20, STORM_TYPE_UNKNOWN_UNICAST, NULL) == STATUS_SUCCESS);
+
+    printf(TEST_PASSED, "test_storm_vlan_byte_limit");
+}
+
+void test_storm_vlan_drop_refunds_port() {
+    storm_limit_t port_limit = { .pps = 10, .burst_packets = 4 };
+    storm_limit_t vlan_limit = { .pps = 10, .burst_packets = 2 };
+    packet_buffer_t packet;
+    int admitted = 0;
+
+    assert(storm_control_set_port(4, STORM_TYPE_MULTICAST, &port_limit) == STATUS_SUCCESS);
+    assert(storm_control_set_vlan(30, STORM_TYPE_MULTICAST, &vlan_limit) == STATUS_SUCCESS);
+
+    make_frame(&packet, g_mcast, 64);
+    for (int i = 0; i < 10; i++) {
+        admitted += storm_control_admit(4, 30, &packet);
+    }
+    assert(admitted == 2);
+
+    // Frames the VLAN dropped did not use up the port's bucket
+    admitted = 0;
+    for (int i = 0; i < 10; i++) {
+        admitted += storm_control_admit(4, 31, &packet);
+    }
+    assert(admitted == 2);
+
+    assert(storm_control_set_port(4, STORM_TYPE_MULTICAST, NULL) == STATUS_SUCCESS);
+    assert(storm_control_set_vlan(30, STORM_TYPE_MULTICAST, NULL) == STATUS_SUCCESS);
+
+    printf(TEST_PASSED, "test_storm_vlan_drop_refunds_port");
+}
+
+static void *storm_flood_thread(void *arg) {
+    packet_buffer_t packet;
+    int *admitted = (int *)arg;
+
+    memset(&packet, 0, sizeof(packet));
+    packet.data = (uint8_t *)g_bcast;
+    packet.size = 6;
+    for (int i = 0; i < STORM_FRAMES_PER_THREAD; i++) {
+        *admitted += storm_control_admit(5, 40, &packet);
+    }
+    return NULL;
+}
+
+void test_storm_concurrent_bound() {
+    // Rate low enough that refill during the test is negligible
+    storm_limit_t limit = { .pps = 1, .burst_packets = 1000 };
+    pthread_t threads[STORM_THREADS];
+    int admitted[STORM_THREADS] = { 0 };
+    int total = 0;
+
+    assert(storm_control_set_vlan(40, STORM_TYPE_BROADCAST, &limit) == STATUS_SUCCESS);
+
+    for (int i = 0; i < STORM_THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, storm_flood_thread, &admitted[i]) == 0);
+    }
+    for (int i = 0; i < STORM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        total += admitted[i];
+    }
+    assert(total >= 1000 && total <= 1010);
+
+    printf(TEST_PASSED, "test_storm_concurrent_bound");
+}
+
+void test_storm_invalid_parameters() {
+    storm_limit_t limit = { .pps = 10 };
+
+    assert(storm_control_set_port(CONFIG_MAX_PORTS, STORM_TYPE_BROADCAST, &limit) == ERROR_INVALID_PARAMETER);
+    assert(storm_control_set_port(0, STORM_TYPE_COUNT, &limit) == ERROR_INVALID_PARAMETER);
+    assert(storm_control_set_vlan(0, STORM_TYPE_BROADCAST, &limit) == ERROR_INVALID_PARAMETER);
+    assert(storm_control_set_vlan(4095, STORM_TYPE_BROADCAST, &limit) == ERROR_INVALID_PARAMETER);
+    assert(storm_control_get_vlan_counters(1, NULL) == ERROR_INVALID_PARAMETER);
+
+    printf(TEST_PASSED, "test_storm_invalid_parameters");
+}
+
+int main() {
+    printf("Running Storm control unit tests...\n");
+
+    assert(storm_control_init() == STATUS_SUCCESS);
+
+    test_storm_classify();
+    test_storm_port_packet_burst();
+    test_storm_vlan_byte_limit();
+    test_storm_vlan_drop_refunds_port();
+    test_storm_concurrent_bound();
+    test_storm_invalid_parameters();
+
+    assert(storm_control_cleanup() == STATUS_SUCCESS);
+
+    printf("All Storm control tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,291 @@
+/**
+ * @file test_telemetry.c
+ * @brief Unit tests for streaming telemetry
+ *
+ * A collector socket on the loopback address decodes what the exporter
+ * sends and rebuilds the counters from keyframes and varint deltas.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../../include/management/telemetry.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define PORTS 4
+#define PORT_WORDS 3
+#define VLANS 512
+#define VLAN_WORDS 2
+
+/* What the collector has rebuilt */
+typedef struct {
+    uint64_t port[PORTS][PORT_WORDS];
+    uint64_t vlan[VLANS][VLAN_WORDS];
+    uint32_t records;           /* Records in the last interval */
+    uint32_t datagrams;         /* Datagrams of the last interval */
+    uint32_t sequence;          /* Next expected datagram */
+    uint32_t interval;
+    bool keyframe;
+} collector_t;
+
+static int g_sock = -1;
+static uint16_t g_port;
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_varint(const uint8_t *buf, size_t len, size_t *off) {
+    uint64_t v = 0;
+
+    for (int shift = 0; *off < len; shift += 7) {
+        uint8_t b = buf[(*off)++];
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return v;
+        }
+    }
+    assert(!"truncated varint");
+    return 0;
+}
+
+/* Apply the records of one datagram; returns true for the last of an interval */
+static bool collect_datagram(collector_t *col) {
+    uint8_t buf[TELEMETRY_MAX_DATAGRAM + 1];
+    ssize_t len = recv(g_sock, buf, sizeof(buf), 0);
+    size_t off = TELEMETRY_HEADER_SIZE;
+
+    assert(len >= TELEMETRY_HEADER_SIZE && len <= TELEMETRY_MAX_DATAGRAM);
+    assert(get_u32(buf) == TELEMETRY_MAGIC && buf[4] == TELEMETRY_VERSION);
+    assert(get_u32(buf + 8) == col->sequence);
+    col->sequence++;
+    if (col->datagrams++ == 0) {
+        col->interval = get_u32(buf + 12);
+        col->keyframe = (buf[5] & TELEMETRY_FLAG_KEYFRAME) != 0;
+    }
+    assert(get_u32(buf + 12) == col->interval);
+    assert(((buf[5] & TELEMETRY_FLAG_KEYFRAME) != 0) == col->keyframe);
+
+    while (off < (size_t)len) {
+        uint8_t obj = buf[off++];
+        uint64_t index = get_varint(buf, (size_t)len, &off);
+        uint64_t mask = get_varint(buf, (size_t)len, &off);
+        uint64_t *counters;
+        uint32_t words;
+
+        if (obj == TELEMETRY_OBJ_PORT) {
+            assert(index < PORTS);
+            counters = col->port[index];
+            words = PORT_WORDS;
+        } else {
+            assert(obj == TELEMETRY_OBJ_VLAN && index < VLANS);
+            counters = col->vlan[index];
+            words = VLAN_WORDS;
+        }
+        assert(mask != 0 && mask < (1u << words));
+        for (uint32_t i = 0; i < words; i++) {
+            if (!(mask & (1u << i))) {
+                continue;
+            }
+            uint64_t v = get_varint(buf, (size_t)len, &off);
+            if (col->keyframe) {
+                counters[i] = v;
+            } else {
+                counters[i] += (uint64_t)((int64_t)(v >> 1) ^ -(int64_t)(v & 1));
+            }
+        }
+        col->records++;
+    }
+    return (buf[5] & TELEMETRY_FLAG_END) != 0;
+}
+
+static void collect_interval(collector_t *col) {
+    col->records = 0;
+    col->datagrams = 0;
+    while (!collect_datagram(col)) {
+    }
+}
+
+static void open_collector(void) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    struct timeval timeout = { .tv_sec = 2 };
+
+    g_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(g_sock >= 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(g_sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(getsockname(g_sock, (struct sockaddr *)&addr, &addr_len) == 0);
+    assert(setsockopt(g_sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0);
+    g_port = ntohs(addr.sin_port);
+}
+
+static telemetry_t *create_exporter(uint32_t subscriptions, uint32_t keyframe_every) {
+    const uint32_t counts[TELEMETRY_OBJ_COUNT] = { PORTS, VLANS, 0, 1, 0 };
+    const uint32_t words[TELEMETRY_OBJ_COUNT] = { PORT_WORDS, VLAN_WORDS, 0, 6, 0 };
+    telemetry_config_t config = {
+        .host = "127.0.0.1",
+        .port = g_port,
+        .interval_ms = 100,
+        .subscriptions = subscriptions,
+        .keyframe_every = keyframe_every,
+    };
+    telemetry_t *tel;
+
+    assert(telemetry_create(&config, counts, words, &tel) == STATUS_SUCCESS);
+    return tel;
+}
+
+static void send_ports(telemetry_t *tel, uint64_t ports[PORTS][PORT_WORDS]) {
+    telemetry_begin(tel);
+    for (uint32_t i = 0; i < PORTS; i++) {
+        telemetry_record(tel, TELEMETRY_OBJ_PORT, i, ports[i]);
+    }
+    telemetry_end(tel);
+}
+
+void test_telemetry_create() {
+    const uint32_t counts[TELEMETRY_OBJ_COUNT] = { PORTS };
+    uint32_t words[TELEMETRY_OBJ_COUNT] = { TELEMETRY_MAX_COUNTERS + 1 };
+    telemetry_config_t config = { .host = "127.0.0.1", .port = g_port, .interval_ms = 100,
+                                  .subscriptions = TELEMETRY_SUBSCRIBE_ALL };
+    telemetry_t *tel;
+
+    assert(telemetry_create(NULL, counts, words, &tel) == STATUS_INVALID_PARAMETER);
+    assert(telemetry_create(&config, counts, words, &tel) == STATUS_INVALID_PARAMETER);
+    words[0] = PORT_WORDS;
+    config.interval_ms = 0;
+    assert(telemetry_create(&config, counts, words, &tel) == STATUS_INVALID_PARAMETER);
+    config.interval_ms = 100;
+    config.host = "no-such-host.invalid";
+    assert(telemetry_create(&config, counts, words, &tel) == STATUS_FAILURE);
+
+    config.host = "127.0.0.1";
+    config.subscriptions = TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_VLAN);
+    assert(telemetry_create(&config, counts, words, &tel) == STATUS_SUCCESS);
+    assert(telemetry_interval_ms(tel) == 100);
+    assert(telemetry_subscribed(tel, TELEMETRY_OBJ_VLAN));
+    assert(!telemetry_subscribed(tel, TELEMETRY_OBJ_PORT));
+    assert(!telemetry_subscribed(tel, TELEMETRY_OBJ_COUNT));
+    telemetry_destroy(tel);
+    telemetry_destroy(NULL);
+
+    printf(TEST_PASSED, "test_telemetry_create");
+}
+
+void test_telemetry_deltas() {
+    collector_t col;
+    uint64_t ports[PORTS][PORT_WORDS];
+    uint64_t routing[6] = { 1 };
+    telemetry_t *tel = create_exporter(TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_PORT), 3);
+
+    memset(&col, 0, sizeof(col));
+    memset(ports, 0, sizeof(ports));
+    ports[0][0] = 10;
+    ports[2][1] = 1ULL << 40;
+
+    // The first interval lists every object with absolute values
+    send_ports(tel, ports);
+    collect_interval(&col);
+    assert(col.keyframe && col.interval == 0 && col.records == PORTS);
+    assert(memcmp(col.port, ports, sizeof(ports)) == 0);
+
+    // Then only what moved, as differences
+    ports[0][0] += 5;
+    ports[3][2] = 300;
+    send_ports(tel, ports);
+    collect_interval(&col);
+    assert(!col.keyframe && col.interval == 1 && col.records == 2);
+    assert(memcmp(col.port, ports, sizeof(ports)) == 0);
+
+    // A cleared counter goes back by a negative difference; objects not
+    // subscribed to are not sent
+    ports[2][1] = 0;
+    telemetry_begin(tel);
+    for (uint32_t i = 0; i < PORTS; i++) {
+        telemetry_record(tel, TELEMETRY_OBJ_PORT, i, ports[i]);
+    }
+    telemetry_record(tel, TELEMETRY_OBJ_ROUTING, 0, routing);
+    telemetry_record(tel, TELEMETRY_OBJ_PORT, PORTS, ports[0]);
+    telemetry_end(tel);
+    collect_interval(&col);
+    assert(col.records == 1 && col.port[2][1] == 0);
+
+    // Every keyframe_every intervals the receiver is resynchronized
+    col.port[1][1] = 12345;
+    send_ports(tel, ports);
+    collect_interval(&col);
+    assert(col.keyframe && col.records == PORTS);
+    assert(memcmp(col.port, ports, sizeof(ports)) == 0);
+
+    // Nothing moved: a header alone, as a heartbeat
+    send_ports(tel, ports);
+    collect_interval(&col);
+    assert(!col.keyframe && col.records == 0 && col.datagrams == 1);
+
+    telemetry_destroy(tel);
+    printf(TEST_PASSED, "test_telemetry_deltas");
+}
+
+void test_telemetry_split() {
+    collector_t col;
+    uint64_t counters[VLAN_WORDS];
+    telemetry_t *tel = create_exporter(TELEMETRY_SUBSCRIBE(TELEMETRY_OBJ_VLAN), 0);
+
+    memset(&col, 0, sizeof(col));
+
+    // A keyframe of large values does not fit one datagram; END marks the last
+    telemetry_begin(tel);
+    for (uint32_t i = 0; i < VLANS; i++) {
+        counters[0] = UINT64_MAX - i;
+        counters[1] = i;
+        telemetry_record(tel, TELEMETRY_OBJ_VLAN, i, counters);
+    }
+    telemetry_end(tel);
+    collect_interval(&col);
+    assert(col.datagrams > 1 && col.records == VLANS);
+    for (uint32_t i = 0; i < VLANS; i++) {
+        assert(col.vlan[i][0] == UINT64_MAX - i && col.vlan[i][1] == i);
+    }
+
+    // Without keyframe_every only the first interval is one
+    for (int interval = 0; interval < 3; interval++) {
+        telemetry_begin(tel);
+        counters[0] = UINT64_MAX;
+        counters[1] = 7;
+        telemetry_record(tel, TELEMETRY_OBJ_VLAN, 0, counters);
+        telemetry_end(tel);
+        collect_interval(&col);
+        assert(!col.keyframe);
+    }
+    assert(col.vlan[0][0] == UINT64_MAX && col.vlan[0][1] == 7);
+
+    telemetry_destroy(tel);
+    printf(TEST_PASSED, "test_telemetry_split");
+}
+
+int main() {
+    printf("Running telemetry unit tests...\n");
+
+    open_collector();
+
+    test_telemetry_create();
+    test_telemetry_deltas();
+    test_telemetry_split();
+
+    close(g_sock);
+
+    printf("All telemetry tests completed successfully.\n");
+    return 0;
+}
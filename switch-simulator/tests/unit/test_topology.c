@@ -0,0 +1,382 @@
+/**
+ * @file test_topology.c
+ * @brief Unit tests for multi-switch topologies in one process
+ *
+ * A chain of switches, each with an edge port of its own, bridges frames
+ * between hosts at the two ends of the chain.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../../include/hal/topology.h"
+#include "../../include/hal/packet.h"
+#include "../../include/hal/port.h"
+#include "../../include/common/switch_context.h"
+#include "../../include/l2/mac_table.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define SWITCHES 4
+#define PORTS 3
+#define UPLINK 0            /* Toward switch n - 1; host A on switch 0 */
+#define DOWNLINK 1          /* Toward switch n + 1; host B on the last switch */
+#define EDGE 2              /* An edge port on every switch */
+#define FRAME_LEN 64
+#define TAG_OFFSET 14
+#define MAX_DELIVERED 64
+#define WAIT_POLLS 2000
+#define LINK_NS 1000
+#define SLOW_LINK_NS 5000
+
+typedef struct {
+    uint32_t sw;
+    port_id_t port;
+    uint8_t tag;
+    uint64_t at_ns;             /* Fabric time of the delivery */
+} delivery_t;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static delivery_t g_delivered[MAX_DELIVERED];
+static uint32_t g_delivered_count;
+
+static const mac_addr_t g_host_a = { .addr = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x0A } };
+static const mac_addr_t g_host_b = { .addr = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x0B } };
+static const mac_addr_t g_host_c = { .addr = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x0C } };
+
+static void deliver(uint32_t sw, port_id_t port_id, packet_buffer_t *packet, void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&g_lock);
+    if (g_delivered_count < MAX_DELIVERED) {
+        g_delivered[g_delivered_count].sw = sw;
+        g_delivered[g_delivered_count].port = port_id;
+        g_delivered[g_delivered_count].tag = packet->data[TAG_OFFSET];
+        g_delivered[g_delivered_count].at_ns = topology_now_ns();
+        g_delivered_count++;
+    }
+    pthread_mutex_unlock(&g_lock);
+    packet_buffer_free(packet);
+}
+
+static uint32_t delivered(void) {
+    uint32_t n;
+
+    pthread_mutex_lock(&g_lock);
+    n = g_delivered_count;
+    pthread_mutex_unlock(&g_lock);
+    return n;
+}
+
+/* Wait for expected deliveries, then a little longer for strays */
+static void wait_delivered(uint32_t expected) {
+    for (int i = 0; i < WAIT_POLLS && delivered() < expected; i++) {
+        usleep(1000);
+    }
+    usleep(10000);
+    assert(delivered() == expected);
+}
+
+static bool was_delivered(uint32_t sw, port_id_t port, uint8_t tag) {
+    bool found = false;
+
+    pthread_mutex_lock(&g_lock);
+    for (uint32_t i = 0; i < g_delivered_count; i++) {
+        if (g_delivered[i].sw == sw && g_delivered[i].port == port && g_delivered[i].tag == tag) {
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    return found;
+}
+
+/* Fabric time a tagged frame left an edge port, 0 if it did not */
+static uint64_t delivered_at(uint32_t sw, port_id_t port, uint8_t tag) {
+    uint64_t at_ns = 0;
+
+    pthread_mutex_lock(&g_lock);
+    for (uint32_t i = 0; i < g_delivered_count; i++) {
+        if (g_delivered[i].sw == sw && g_delivered[i].port == port && g_delivered[i].tag == tag) {
+            at_ns = g_delivered[i].at_ns;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    return at_ns;
+}
+
+static void reset_delivered(void) {
+    pthread_mutex_lock(&g_lock);
+    g_delivered_count = 0;
+    pthread_mutex_unlock(&g_lock);
+}
+
+/* An untagged frame of a local experimental EtherType */
+static packet_buffer_t *make_frame(const mac_addr_t *dst, const mac_addr_t *src, uint8_t tag) {
+    uint8_t frame[FRAME_LEN];
+    packet_buffer_t *pkt = packet_buffer_alloc(FRAME_LEN);
+
+    assert(pkt != NULL);
+    memset(frame, 0, sizeof(frame));
+    memcpy(frame, dst->addr, MAC_ADDR_LEN);
+    memcpy(frame + MAC_ADDR_LEN, src->addr, MAC_ADDR_LEN);
+    frame[12] = 0x88;
+    frame[13] = 0xB5;
+    frame[TAG_OFFSET] = tag;
+    assert(packet_append_data(pkt, frame, FRAME_LEN) == STATUS_SUCCESS);
+    return pkt;
+}
+
+static void inject(uint32_t sw, port_id_t port, const mac_addr_t *dst, const mac_addr_t *src, uint8_t tag) {
+    packet_buffer_t *pkt = make_frame(dst, src, tag);
+
+    assert(topology_inject(sw, port, &pkt, 1) == 1);
+}
+
+static status_t lookup(uint32_t instance, const mac_addr_t *mac, port_id_t *port) {
+    status_t status;
+
+    assert(switch_context_bind(instance) == STATUS_SUCCESS);
+    status = mac_table_lookup(*mac, 1, port);
+    assert(switch_context_bind(SWITCH_INSTANCE_DEFAULT) == STATUS_SUCCESS);
+    return status;
+}
+
+static void *report_instance(void *arg) {
+    *(uint32_t *)arg = switch_context_current();
+    return NULL;
+}
+
+void test_switch_context() {
+    pthread_t thread;
+    uint32_t instance = 1;
+
+    assert(switch_context_current() == SWITCH_INSTANCE_DEFAULT);
+    assert(switch_context_bind(CONFIG_MAX_SWITCH_INSTANCES) == STATUS_INVALID_PARAMETER);
+    assert(switch_context_bind(5) == STATUS_SUCCESS);
+    assert(switch_context_current() == 5);
+
+    // Every thread starts on the process's own switch
+    assert(pthread_create(&thread, NULL, report_instance, &instance) == 0);
+    assert(pthread_join(thread, NULL) == 0);
+    assert(instance == SWITCH_INSTANCE_DEFAULT);
+
+    assert(switch_context_bind(SWITCH_INSTANCE_DEFAULT) == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_switch_context");
+}
+
+void test_topology_config() {
+    topology_config_t config;
+    topology_switch_stats_t stats;
+
+    assert(topology_link(0, 0, 1, 0) == STATUS_NOT_INITIALIZED);
+    assert(topology_start() == STATUS_NOT_INITIALIZED);
+    assert(topology_get_switch_stats(0, &stats) == STATUS_NOT_INITIALIZED);
+    assert(topology_shutdown() == STATUS_NOT_INITIALIZED);
+
+    topology_get_default_config(&config);
+    assert(config.num_switches > 0 && config.ports_per_switch > 0 && config.ring_size > 0);
+
+    config.num_switches = 0;
+    assert(topology_init(&config) == STATUS_INVALID_PARAMETER);
+    config.num_switches = CONFIG_MAX_SWITCH_INSTANCES;
+    assert(topology_init(&config) == STATUS_INVALID_PARAMETER);
+    config.num_switches = SWITCHES;
+    config.ring_size = 100;
+    assert(topology_init(&config) == STATUS_INVALID_PARAMETER);
+    config.ring_size = 64;
+    config.ports_per_switch = 0;
+    assert(topology_init(&config) == STATUS_INVALID_PARAMETER);
+    assert(topology_init(NULL) == STATUS_INVALID_PARAMETER);
+
+    printf(TEST_PASSED, "test_topology_config");
+}
+
+void test_topology_chain() {
+    topology_config_t config;
+    topology_switch_stats_t stats;
+    port_id_t port;
+
+    topology_get_default_config(&config);
+    config.num_switches = SWITCHES;
+    config.ports_per_switch = PORTS;
+    config.num_workers = 2;
+    config.ring_size = 64;
+    config.link_latency_ns = 0;
+    assert(topology_init(&config) == STATUS_SUCCESS);
+    assert(topology_init(&config) == STATUS_ALREADY_INITIALIZED);
+
+    // Switches live on instances of their own, not on the process's
+    for (uint32_t s = 0; s < SWITCHES; s++) {
+        assert(topology_instance(s) != SWITCH_INSTANCE_DEFAULT);
+        assert(s == 0 || topology_instance(s) != topology_instance(s - 1));
+    }
+    assert(topology_instance(SWITCHES) == SWITCH_INSTANCE_DEFAULT);
+
+    for (uint32_t s = 0; s + 1 < SWITCHES; s++) {
+        assert(topology_link(s, DOWNLINK, s + 1, UPLINK) == STATUS_SUCCESS);
+    }
+    assert(topology_link(0, DOWNLINK, 2, EDGE) == STATUS_INVALID_PARAMETER);
+    assert(topology_link(0, EDGE, 0, EDGE) == STATUS_INVALID_PARAMETER);
+    assert(topology_link(0, PORTS, 1, EDGE) == STATUS_INVALID_PARAMETER);
+    assert(topology_link(0, EDGE, SWITCHES, EDGE) == STATUS_INVALID_PARAMETER);
+    assert(topology_set_deliver(deliver, NULL) == STATUS_SUCCESS);
+
+    // Only edge ports take injected frames
+    packet_buffer_t *pkt = make_frame(&g_host_b, &g_host_a, 0);
+    assert(topology_inject(0, DOWNLINK, &pkt, 1) == 0);
+    assert(topology_inject(SWITCHES, EDGE, &pkt, 1) == 0);
+    packet_buffer_free(pkt);
+
+    assert(topology_start() == STATUS_SUCCESS);
+    assert(topology_start() == STATUS_RESOURCE_BUSY);
+    assert(topology_link(0, EDGE, 1, EDGE) == STATUS_RESOURCE_BUSY);
+    assert(topology_set_deliver(NULL, NULL) == STATUS_RESOURCE_BUSY);
+
+    // An unknown destination floods the whole chain, every edge port but the ingress
+    inject(0, UPLINK, &g_host_b, &g_host_a, 1);
+    wait_delivered(SWITCHES + 1);
+    for (uint32_t s = 0; s < SWITCHES; s++) {
+        assert(was_delivered(s, EDGE, 1));
+    }
+    assert(was_delivered(SWITCHES - 1, DOWNLINK, 1));
+
+    // Every switch learned A toward switch 0, in its own table
+    for (uint32_t s = 0; s < SWITCHES; s++) {
+        assert(lookup(topology_instance(s), &g_host_a, &port) == STATUS_SUCCESS);
+        assert(port == UPLINK);
+    }
+    assert(lookup(SWITCH_INSTANCE_DEFAULT, &g_host_a, &port) != STATUS_SUCCESS);
+
+    // The reply goes straight back, and then so does the next frame
+    reset_delivered();
+    inject(SWITCHES - 1, DOWNLINK, &g_host_a, &g_host_b, 2);
+    wait_delivered(1);
+    assert(was_delivered(0, UPLINK, 2));
+    reset_delivered();
+    inject(0, UPLINK, &g_host_b, &g_host_a, 3);
+    wait_delivered(1);
+    assert(was_delivered(SWITCHES - 1, DOWNLINK, 3));
+
+    // A frame for a host behind its own ingress port is filtered
+    reset_delivered();
+    inject(0, UPLINK, &g_host_a, &g_host_c, 4);
+    wait_delivered(0);
+
+    assert(topology_get_switch_stats(0, &stats) == STATUS_SUCCESS);
+    assert(stats.rx_packets == 4 && stats.flooded == 1 && stats.forwarded == 2);
+    assert(stats.filtered == 1 && stats.delivered == 2 && stats.dropped == 0);
+    assert(topology_get_switch_stats(SWITCHES - 1, &stats) == STATUS_SUCCESS);
+    assert(stats.rx_packets == 3 && stats.delivered == 3 && stats.link_drops == 0);
+    assert(topology_get_switch_stats(SWITCHES, &stats) == STATUS_INVALID_PARAMETER);
+
+    // Without a fabric clock there is no fabric time
+    assert(topology_now_ns() == 0);
+
+    assert(topology_shutdown() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_topology_chain");
+}
+
+/*
+ * Run one flood through a chain whose middle link is slower than the
+ * others; times[s] is when it left switch s's edge port, times[SWITCHES]
+ * when it left the far end
+ */
+static void run_fabric(uint32_t workers, uint64_t times[SWITCHES + 1]) {
+    const uint64_t start_ns = 1000000;
+    topology_config_t config;
+    topology_clock_stats_t clock;
+    packet_buffer_t *pkt;
+
+    topology_get_default_config(&config);
+    config.num_switches = SWITCHES;
+    config.ports_per_switch = PORTS;
+    config.num_workers = workers;
+    config.ring_size = 64;
+    config.link_latency_ns = LINK_NS;
+    assert(topology_init(&config) == STATUS_SUCCESS);
+
+    assert(topology_link(0, DOWNLINK, 1, UPLINK) == STATUS_SUCCESS);
+    assert(topology_link_latency(1, DOWNLINK, 2, UPLINK, SLOW_LINK_NS) == STATUS_SUCCESS);
+    assert(topology_link(2, DOWNLINK, 3, UPLINK) == STATUS_SUCCESS);
+    assert(topology_link_latency(0, EDGE, 1, EDGE, 0) == STATUS_INVALID_PARAMETER);
+    assert(topology_set_deliver(deliver, NULL) == STATUS_SUCCESS);
+    reset_delivered();
+
+    // Nothing to do: the clock does not move
+    assert(topology_start() == STATUS_SUCCESS);
+    usleep(5000);
+    assert(topology_get_clock_stats(&clock) == STATUS_SUCCESS);
+    assert(clock.synchronized && clock.lookahead_ns == LINK_NS && clock.windows == 0);
+
+    pkt = make_frame(&g_host_b, &g_host_a, 1);
+    assert(topology_inject_at(0, UPLINK, &pkt, 1, start_ns) == 1);
+    wait_delivered(SWITCHES + 1);
+    for (uint32_t s = 0; s < SWITCHES; s++) {
+        times[s] = delivered_at(s, EDGE, 1);
+    }
+    times[SWITCHES] = delivered_at(SWITCHES - 1, DOWNLINK, 1);
+
+    // The idle time before the frame was jumped, not run through
+    assert(topology_get_clock_stats(&clock) == STATUS_SUCCESS);
+    assert(clock.skipped_ns >= start_ns - LINK_NS);
+    assert(clock.windows > 0 && clock.windows < 20);
+    assert(clock.now_ns >= times[SWITCHES]);
+
+    // A time the fabric has passed becomes the earliest still possible; B is
+    // still unknown, so it floods again
+    pkt = make_frame(&g_host_b, &g_host_a, 2);
+    assert(topology_inject_at(0, UPLINK, &pkt, 1, 0) == 1);
+    wait_delivered(2 * (SWITCHES + 1));
+    assert(delivered_at(SWITCHES - 1, DOWNLINK, 2) >= times[SWITCHES] + 2 * LINK_NS + SLOW_LINK_NS);
+
+    assert(topology_shutdown() == STATUS_SUCCESS);
+}
+
+void test_topology_fabric_clock() {
+    topology_config_t config;
+    uint64_t times[SWITCHES + 1];
+    uint64_t again[SWITCHES + 1];
+
+    // Links of their own latency need a fabric clock
+    topology_get_default_config(&config);
+    config.link_latency_ns = 0;
+    assert(topology_init(&config) == STATUS_SUCCESS);
+    assert(topology_link_latency(0, 0, 1, 0, LINK_NS) == STATUS_NOT_SUPPORTED);
+    assert(topology_shutdown() == STATUS_SUCCESS);
+
+    // A frame reaches each switch after the latency of every link on its way
+    run_fabric(1, times);
+    assert(times[0] == 1000000);
+    assert(times[1] == times[0] + LINK_NS);
+    assert(times[2] == times[1] + SLOW_LINK_NS);
+    assert(times[3] == times[2] + LINK_NS && times[SWITCHES] == times[3]);
+
+    // Whatever the number of workers
+    run_fabric(3, again);
+    assert(memcmp(times, again, sizeof(times)) == 0);
+
+    printf(TEST_PASSED, "test_topology_fabric_clock");
+}
+
+int main() {
+    printf("Running topology unit tests...\n");
+
+    // MAC tables of every instance learn only ports the port layer knows
+    assert(port_init() == STATUS_SUCCESS);
+    assert(packet_init() == STATUS_SUCCESS);
+
+    test_switch_context();
+    test_topology_config();
+    test_topology_chain();
+    test_topology_fabric_clock();
+
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All topology tests completed successfully.\n");
+    return 0;
+}
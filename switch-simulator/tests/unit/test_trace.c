@@ -0,0 +1,209 @@
+/**
+ * @file test_trace.c
+ * @brief Unit tests for binary tracing
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../../include/common/trace.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define THREAD_RECORDS 100
+
+static int g_evaluated;
+
+/* Counts how often a tracepoint evaluated its arguments */
+static uint32_t evaluate(uint32_t value) {
+    g_evaluated++;
+    return value;
+}
+
+static void *record_thread(void *arg) {
+    uint32_t base = *(uint32_t *)arg;
+
+    for (uint32_t i = 0; i < THREAD_RECORDS; i++) {
+        TRACE_POINT(TRACE_STP_STATE, base + i, 0, 0);
+    }
+    return NULL;
+}
+
+static void run_thread(uint32_t base) {
+    pthread_t thread;
+
+    assert(pthread_create(&thread, NULL, record_thread, &base) == 0);
+    assert(pthread_join(thread, NULL) == 0);
+}
+
+static uint64_t recorded(void) {
+    uint64_t n;
+
+    trace_get_counts(&n, NULL);
+    return n;
+}
+
+/* Read a trace file back; returns its records, header in *header */
+static trace_record_t *read_dump(const char *path, trace_file_header_t *header) {
+    char names[TRACE_EVENT_COUNT][TRACE_NAME_MAX];
+    trace_record_t *records;
+    FILE *file = fopen(path, "rb");
+
+    assert(file != NULL);
+    assert(fread(header, sizeof(*header), 1, file) == 1);
+    assert(memcmp(header->magic, TRACE_FILE_MAGIC, sizeof(header->magic)) == 0);
+    assert(header->record_size == sizeof(trace_record_t));
+    assert(header->event_count == TRACE_EVENT_COUNT);
+    assert(fread(names, sizeof(names), 1, file) == 1);
+    for (uint32_t e = 0; e < TRACE_EVENT_COUNT; e++) {
+        assert(strcmp(names[e], trace_event_name((trace_event_t)e)) == 0);
+    }
+
+    records = (trace_record_t *)malloc(sizeof(trace_record_t) * (header->record_count + 1));
+    assert(records != NULL);
+    assert(fread(records, sizeof(trace_record_t), header->record_count, file) == header->record_count);
+    assert(fgetc(file) == EOF);
+    fclose(file);
+    return records;
+}
+
+void test_trace_events() {
+    trace_event_t event;
+
+    assert(strcmp(trace_event_name(TRACE_MAC_LEARN), "mac-learn") == 0);
+    assert(strcmp(trace_event_name(TRACE_EVENT_COUNT), "unknown") == 0);
+    for (uint32_t e = 0; e < TRACE_EVENT_COUNT; e++) {
+        assert(trace_event_from_name(trace_event_name((trace_event_t)e), &event) == STATUS_SUCCESS);
+        assert(event == (trace_event_t)e);
+    }
+    assert(trace_event_from_name("mac", &event) == STATUS_NOT_FOUND);
+    assert(trace_event_from_name(NULL, &event) == STATUS_INVALID_PARAMETER);
+
+    // Events are switched on and off one by one
+    assert(trace_get_events() == 0);
+    trace_enable((1ULL << TRACE_ROUTE_ADD) | (1ULL << 63));
+    assert(trace_get_events() == (1ULL << TRACE_ROUTE_ADD));
+    assert(trace_enabled(TRACE_ROUTE_ADD) && !trace_enabled(TRACE_ROUTE_REMOVE));
+    trace_enable(TRACE_ALL_EVENTS);
+    trace_disable(1ULL << TRACE_ROUTE_ADD);
+    assert(trace_get_events() == (TRACE_ALL_EVENTS & ~(1ULL << TRACE_ROUTE_ADD)));
+
+    // A tracepoint of an event that is off neither records nor evaluates
+    trace_clear();
+    g_evaluated = 0;
+    TRACE_POINT(TRACE_ROUTE_ADD, evaluate(1), 0, 0);
+    assert(g_evaluated == 0 && recorded() == 0);
+    TRACE_POINT(TRACE_ROUTE_REMOVE, evaluate(1), 0, 0);
+    assert(g_evaluated == 1 && recorded() == 1);
+
+    trace_disable(TRACE_ALL_EVENTS);
+    assert(trace_get_events() == 0);
+    trace_clear();
+
+    printf(TEST_PASSED, "test_trace_events");
+}
+
+void test_trace_ring() {
+    uint64_t kept;
+    uint64_t lost;
+
+    trace_enable(1ULL << TRACE_MAC_LEARN);
+    trace_clear();
+
+    // A ring keeps the newest records and counts the ones written over
+    for (uint32_t i = 0; i < CONFIG_TRACE_RING_SIZE + 100; i++) {
+        TRACE_POINT(TRACE_MAC_LEARN, i, 0, 0);
+    }
+    trace_get_counts(&kept, &lost);
+    assert(kept == CONFIG_TRACE_RING_SIZE && lost == 100);
+    trace_get_counts(NULL, NULL);
+
+    trace_clear();
+    trace_get_counts(&kept, &lost);
+    assert(kept == 0 && lost == 0);
+
+    TRACE_POINT(TRACE_MAC_LEARN, 1, 0, 0);
+    assert(recorded() == 1);
+
+    trace_disable(TRACE_ALL_EVENTS);
+    trace_clear();
+    printf(TEST_PASSED, "test_trace_ring");
+}
+
+void test_trace_dump() {
+    char path[] = "/tmp/test_trace_XXXXXX";
+    mac_addr_t mac = { .addr = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55 } };
+    trace_file_header_t header;
+    trace_record_t *records;
+    uint64_t written;
+    uint16_t main_ring;
+    uint16_t thread_ring;
+    int fd = mkstemp(path);
+
+    assert(fd >= 0);
+    close(fd);
+    assert(trace_dump(NULL, &written) == STATUS_INVALID_PARAMETER);
+    assert(trace_dump("/nonexistent/dir/trace.bin", &written) == STATUS_FAILURE);
+
+    trace_enable(TRACE_ALL_EVENTS);
+    trace_clear();
+    TRACE_POINT(TRACE_MAC_MOVE, 7, trace_mac_arg(&mac, 100), 3);
+    TRACE_POINT(TRACE_ARP_STATE, 1, 0x0100000A, 0);
+    run_thread(1000);
+
+    // A released ring is taken over, records and all, by the next thread
+    run_thread(2000);
+    assert(recorded() == 2 + 2 * THREAD_RECORDS);
+
+    assert(trace_dump(path, &written) == STATUS_SUCCESS);
+    assert(written == 2 + 2 * THREAD_RECORDS);
+    records = read_dump(path, &header);
+    assert(header.record_count == written);
+    assert(header.start_tsc > 0 && header.start_ns > 0 && header.ticks_per_ns > 0.0);
+
+    // One ring per thread, in time order within it
+    main_ring = records[0].ring;
+    thread_ring = records[2].ring;
+    assert(main_ring != thread_ring);
+    assert(records[0].event == TRACE_MAC_MOVE && records[0].a0 == 7 && records[0].a2 == 3);
+    assert(records[0].a1 == 0x0064001122334455ULL);
+    assert(records[1].event == TRACE_ARP_STATE && records[1].a1 == 0x0100000A);
+    assert(records[0].tsc <= records[1].tsc && records[0].tsc >= header.start_tsc);
+    for (uint32_t i = 0; i < 2 * THREAD_RECORDS; i++) {
+        const trace_record_t *r = &records[2 + i];
+
+        assert(r->ring == thread_ring && r->event == TRACE_STP_STATE);
+        assert(r->a0 == (i < THREAD_RECORDS ? 1000 + i : 2000 + i - THREAD_RECORDS));
+        assert(i == 0 || r->tsc >= r[-1].tsc);
+    }
+    free(records);
+
+    // What was cleared is not written
+    trace_clear();
+    assert(trace_dump(path, NULL) == STATUS_SUCCESS);
+    records = read_dump(path, &header);
+    assert(header.record_count == 0);
+    free(records);
+
+    trace_disable(TRACE_ALL_EVENTS);
+    unlink(path);
+    printf(TEST_PASSED, "test_trace_dump");
+}
+
+int main() {
+    printf("Running trace unit tests...\n");
+
+    assert(trace_init() == STATUS_SUCCESS);
+
+    test_trace_events();
+    test_trace_ring();
+    test_trace_dump();
+
+    printf("All trace tests completed successfully.\n");
+    return 0;
+}
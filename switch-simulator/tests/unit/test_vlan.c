@@ -8,210 +8,339 @@
 #include <string.h>
 #include <assert.h>
 #include "../../include/l2/vlan.h"
+#include "../../include/hal/packet.h"
+#include "../../include/hal/port.h"
 #include "../../include/common/error_codes.h"
 
 #define TEST_PASSED "[ PASSED ] %s\n"
 #define TEST_FAILED "[ FAILED ] %s: %s\n"
 
+#define NUM_PORTS 16
+#define FRAME_LEN 60
+
+static packet_buffer_t *make_frame(vlan_id_t tag) {
+    uint8_t frame[FRAME_LEN] = {0};
+    packet_buffer_t *pkt = packet_buffer_alloc(128);
+
+    memset(frame, 0xAA, 6);          // dst
+    memset(frame + 6, 0xBB, 6);      // src
+    frame[12] = 0x88; frame[13] = 0xB5;
+    frame[14] = 0x5A;
+
+    assert(pkt != NULL);
+    assert(packet_append_data(pkt, frame, sizeof(frame)) == STATUS_SUCCESS);
+    if (tag != VLAN_ID_INVALID) {
+        assert(packet_vlan_push(pkt, ETHERTYPE_VLAN, tag) == STATUS_SUCCESS);
+    }
+    assert(packet_parse(pkt) == STATUS_SUCCESS);
+    return pkt;
+}
+
+static uint16_t outer_tpid(const packet_buffer_t *pkt) {
+    return (uint16_t)((pkt->data[12] << 8) | pkt->data[13]);
+}
+
 void test_vlan_create() {
-    vlan_table_t vlan_table;
-    uint32_t result = vlan_table_init(&vlan_table, 4096);
-    assert(result == SUCCESS);
-    
+    vlan_entry_t entry;
+
+    assert(vlan_init(NUM_PORTS) == STATUS_SUCCESS);
+
+    // The default VLAN exists with every port as an untagged member
+    assert(vlan_get(VLAN_ID_DEFAULT, &entry) == STATUS_SUCCESS);
+    assert(entry.is_active);
+
     // Create a new VLAN
-    uint16_t vlan_id = 100;
-    char vlan_name[] = "test_vlan";
-    result = vlan_create(&vlan_table, vlan_id, vlan_name);
-    assert(result == SUCCESS);
-    
+    assert(vlan_create(100, "test_vlan") == STATUS_SUCCESS);
+    assert(vlan_get(100, &entry) == STATUS_SUCCESS);
+    assert(entry.vlan_id == 100 && strcmp(entry.name, "test_vlan") == 0);
+
     // Try to create an existing VLAN
-    result = vlan_create(&vlan_table, vlan_id, "another_name");
-    assert(result == VLAN_EXISTS);
-    
+    assert(vlan_create(100, "another_name") == STATUS_ALREADY_EXISTS);
+
     // Try to create an invalid VLAN ID
-    result = vlan_create(&vlan_table, 4097, "invalid_vlan");
-    assert(result == INVALID_VLAN_ID);
-    
-    vlan_table_destroy(&vlan_table);
+    assert(vlan_create(4097, "invalid_vlan") == ERROR_INVALID_PARAMETER);
+    assert(vlan_create(VLAN_ID_INVALID, "invalid_vlan") == ERROR_INVALID_PARAMETER);
+
+    assert(vlan_deinit() == STATUS_SUCCESS);
     printf(TEST_PASSED, "test_vlan_create");
 }
 
 void test_vlan_delete() {
-    vlan_table_t vlan_table;
-    vlan_table_init(&vlan_table, 4096);
-    
-    // Create a VLAN
-    uint16_t vlan_id = 100;
-    vlan_create(&vlan_table, vlan_id, "test_vlan");
-    
+    vlan_entry_t entry;
+
+    assert(vlan_init(NUM_PORTS) == STATUS_SUCCESS);
+    assert(vlan_create(100, "test_vlan") == STATUS_SUCCESS);
+
     // Delete existing VLAN
-    uint32_t result = vlan_delete(&vlan_table, vlan_id);
-    assert(result == SUCCESS);
-    
+    assert(vlan_delete(100) == STATUS_SUCCESS);
+    assert(vlan_get(100, &entry) != STATUS_SUCCESS);
+
     // Try to delete non-existing VLAN
-    result = vlan_delete(&vlan_table, vlan_id);
-    assert(result == VLAN_NOT_FOUND);
-    
+    assert(vlan_delete(100) == STATUS_NOT_FOUND);
+
     // Try to delete default VLAN
-    result = vlan_delete(&vlan_table, 1);
-    assert(result == VLAN_OPERATION_NOT_PERMITTED);
-    
-    vlan_table_destroy(&vlan_table);
+    assert(vlan_delete(VLAN_ID_DEFAULT) == STATUS_PERMISSION_DENIED);
+
+    assert(vlan_deinit() == STATUS_SUCCESS);
     printf(TEST_PASSED, "test_vlan_delete");
 }
 
+void test_vlan_range() {
+    vlan_port_bitmap_t members;
+
+    assert(vlan_init(NUM_PORTS) == STATUS_SUCCESS);
+    assert(vlan_create(205, NULL) == STATUS_SUCCESS);
+
+    // A range overlapping an existing VLAN creates nothing
+    assert(vlan_create_range(200, 210) == STATUS_ALREADY_EXISTS);
+    assert(vlan_get_member_bitmaps(200, &members, NULL) == STATUS_NOT_FOUND);
+
+    assert(vlan_create_range(300, 310) == STATUS_SUCCESS);
+    assert(vlan_get_member_bitmaps(300, &members, NULL) == STATUS_SUCCESS);
+    assert(vlan_get_member_bitmaps(310, &members, NULL) == STATUS_SUCCESS);
+    assert(vlan_get_member_bitmaps(311, &members, NULL) == STATUS_NOT_FOUND);
+
+    assert(vlan_deinit() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_vlan_range");
+}
+
 void test_port_vlan_membership() {
-    vlan_table_t vlan_table;
-    vlan_table_init(&vlan_table, 4096);
-    
-    uint16_t vlan_id = 100;
-    uint32_t port_id = 5;
-    
-    vlan_create(&vlan_table, vlan_id, "test_vlan");
-    
-    // Add port to VLAN
-    uint32_t result = vlan_add_port(&vlan_table, vlan_id, port_id, VLAN_PORT_UNTAGGED);
-    assert(result == SUCCESS);
-    
-    // Verify port membership
-    vlan_port_info_t port_info;
-    result = vlan_get_port_info(&vlan_table, vlan_id, port_id, &port_info);
-    assert(result == SUCCESS);
-    assert(port_info.membership == VLAN_PORT_UNTAGGED);
-    
-    // Change port membership
-    result = vlan_add_port(&vlan_table, vlan_id, port_id, VLAN_PORT_TAGGED);
-    assert(result == SUCCESS);
-    
-    // Verify updated port membership
-    result = vlan_get_port_info(&vlan_table, vlan_id, port_id, &port_info);
-    assert(result == SUCCESS);
-    assert(port_info.membership == VLAN_PORT_TAGGED);
-    
-    // Remove port from VLAN
-    result = vlan_remove_port(&vlan_table, vlan_id, port_id);
-    assert(result == SUCCESS);
-    
-    // Verify port is removed
-    result = vlan_get_port_info(&vlan_table, vlan_id, port_id, &port_info);
-    assert(result == VLAN_PORT_NOT_MEMBER);
-    
-    vlan_table_destroy(&vlan_table);
+    vlan_port_bitmap_t members, untagged, flood;
+    vlan_member_t bulk[3] = {
+        { .vlan_id = 100, .port_id = 6, .member_type = VLAN_MEMBER_TAGGED },
+        { .vlan_id = 999, .port_id = 7, .member_type = VLAN_MEMBER_TAGGED },
+        { .vlan_id = 100, .port_id = 8, .member_type = VLAN_MEMBER_UNTAGGED },
+    };
+    status_t statuses[3];
+
+    assert(vlan_init(NUM_PORTS) == STATUS_SUCCESS);
+    assert(vlan_create(100, "test_vlan") == STATUS_SUCCESS);
+
+    // Add ports to the VLAN
+    assert(vlan_add_port(100, 5, VLAN_MEMBER_UNTAGGED) == STATUS_SUCCESS);
+    assert(vlan_add_port(100, 4, VLAN_MEMBER_TAGGED) == STATUS_SUCCESS);
+    assert(vlan_get_member_bitmaps(100, &members, &untagged) == STATUS_SUCCESS);
+    assert(members.w[0] == ((1ULL << 4) | (1ULL << 5)));
+    assert(untagged.w[0] == (1ULL << 5));
+
+    // Invalid ports and VLANs are refused
+    assert(vlan_add_port(100, NUM_PORTS, VLAN_MEMBER_TAGGED) == ERROR_INVALID_PARAMETER);
+    assert(vlan_add_port(101, 5, VLAN_MEMBER_TAGGED) == STATUS_NOT_FOUND);
+
+    // Re-adding a member changes its tagging
+    assert(vlan_add_port(100, 5, VLAN_MEMBER_TAGGED) == STATUS_SUCCESS);
+    assert(vlan_get_member_bitmaps(100, NULL, &untagged) == STATUS_SUCCESS);
+    assert(untagged.w[0] == 0);
+
+    // The flood set is every member but the ingress port
+    assert(vlan_get_flood_ports(100, 4, &flood) == STATUS_SUCCESS);
+    assert(flood.w[0] == (1ULL << 5));
+
+    // A bulk add reports each membership and keeps going past a failure
+    assert(vlan_add_members_bulk(bulk, 3, false, statuses) == STATUS_NOT_FOUND);
+    assert(statuses[0] == STATUS_SUCCESS && statuses[1] == STATUS_NOT_FOUND && statuses[2] == STATUS_SUCCESS);
+    assert(vlan_get_member_bitmaps(100, &members, &untagged) == STATUS_SUCCESS);
+    assert(members.w[0] == ((1ULL << 4) | (1ULL << 5) | (1ULL << 6) | (1ULL << 8)));
+    assert(untagged.w[0] == (1ULL << 8));
+
+    // Remove ports from the VLAN
+    assert(vlan_remove_port(100, 5) == STATUS_SUCCESS);
+    assert(vlan_remove_members_bulk(bulk, 1, true, NULL) == STATUS_SUCCESS);
+    assert(vlan_get_member_bitmaps(100, &members, NULL) == STATUS_SUCCESS);
+    assert(members.w[0] == ((1ULL << 4) | (1ULL << 8)));
+
+    // Deleting the VLAN drops its members
+    assert(vlan_delete(100) == STATUS_SUCCESS);
+    assert(vlan_get_member_bitmaps(100, &members, NULL) == STATUS_NOT_FOUND);
+
+    assert(vlan_deinit() == STATUS_SUCCESS);
     printf(TEST_PASSED, "test_port_vlan_membership");
 }
 
-void test_vlan_port_operations() {
-    vlan_table_t vlan_table;
-    vlan_table_init(&vlan_table, 4096);
-    
-    // Create multiple VLANs
-    vlan_create(&vlan_table, 100, "vlan_100");
-    vlan_create(&vlan_table, 200, "vlan_200");
-    vlan_create(&vlan_table, 300, "vlan_300");
-    
-    uint32_t port_id = 5;
-    
-    // Add port to multiple VLANs with different memberships
-    uint32_t result;
-    result = vlan_add_port(&vlan_table, 100, port_id, VLAN_PORT_UNTAGGED);
-    assert(result == SUCCESS);
-    
-    result = vlan_add_port(&vlan_table, 200, port_id, VLAN_PORT_TAGGED);
-    assert(result == SUCCESS);
-    
-    result = vlan_add_port(&vlan_table, 300, port_id, VLAN_PORT_TAGGED);
-    assert(result == SUCCESS);
-    
-    // Get all VLANs for a port
-    vlan_port_membership_t memberships[10];
-    uint32_t count = 0;
-    result = vlan_get_port_memberships(&vlan_table, port_id, memberships, 10, &count);
-    assert(result == SUCCESS);
-    assert(count == 3);
-    
-    // Verify memberships
-    bool found_vlan100 = false;
-    bool found_vlan200 = false;
-    bool found_vlan300 = false;
-    
-    for (int i = 0; i < count; i++) {
-        if (memberships[i].vlan_id == 100) {
-            assert(memberships[i].membership == VLAN_PORT_UNTAGGED);
-            found_vlan100 = true;
-        } else if (memberships[i].vlan_id == 200) {
-            assert(memberships[i].membership == VLAN_PORT_TAGGED);
-            found_vlan200 = true;
-        } else if (memberships[i].vlan_id == 300) {
-            assert(memberships[i].membership == VLAN_PORT_TAGGED);
-            found_vlan300 = true;
+void test_vlan_ingress_classification() {
+    packet_buffer_t *untagged = make_frame(VLAN_ID_INVALID);
+    packet_buffer_t *tagged = make_frame(100);
+    vlan_id_t vlan_id = VLAN_ID_INVALID;
+
+    assert(vlan_init(NUM_PORTS) == STATUS_SUCCESS);
+    assert(vlan_create(100, "test_vlan") == STATUS_SUCCESS);
+    assert(vlan_add_port(100, 2, VLAN_MEMBER_TAGGED) == STATUS_SUCCESS);
+
+    // Untagged frames go to the port's PVID
+    assert(vlan_get_packet_vlan(1, untagged, &vlan_id) == STATUS_SUCCESS);
+    assert(vlan_id == VLAN_ID_DEFAULT);
+
+    // Access ports drop tagged frames
+    assert(vlan_get_packet_vlan(2, tagged, &vlan_id) == ERROR_INVALID_PACKET);
+
+    // Customer edge ports take C-tagged frames into their S-VLAN
+    assert(vlan_set_port_qinq_mode(2, VLAN_QINQ_CUSTOMER) == STATUS_SUCCESS);
+    assert(vlan_set_svlan_translation(2, 100, 100) == STATUS_SUCCESS);
+    assert(vlan_get_packet_vlan(2, tagged, &vlan_id) == STATUS_SUCCESS);
+    assert(vlan_id == 100);
+
+    // Ports beyond the configured count have no classification
+    assert(vlan_get_packet_vlan(NUM_PORTS, untagged, &vlan_id) == ERROR_INVALID_PARAMETER);
+
+    assert(vlan_deinit() == STATUS_SUCCESS);
+    packet_buffer_free(untagged);
+    packet_buffer_free(tagged);
+    printf(TEST_PASSED, "test_vlan_ingress_classification");
+}
+
+void test_vlan_egress_push_pop() {
+    packet_buffer_t *pkt = make_frame(VLAN_ID_INVALID);
+    packet_buffer_t *out = packet_buffer_alloc(128);
+    uint32_t headroom = packet_headroom(pkt);
+    vlan_id_t vid = 0;
+
+    assert(vlan_init(NUM_PORTS) == STATUS_SUCCESS);
+    assert(vlan_create(100, "test_vlan") == STATUS_SUCCESS);
+    assert(vlan_add_port(100, 3, VLAN_MEMBER_TAGGED) == STATUS_SUCCESS);
+    assert(vlan_add_port(100, 4, VLAN_MEMBER_UNTAGGED) == STATUS_SUCCESS);
+
+    // A tagged member gets the tag pushed into headroom
+    assert(vlan_process_egress_inplace(pkt, 100, 3) == STATUS_SUCCESS);
+    assert(pkt->size == FRAME_LEN + 4 && packet_headroom(pkt) == headroom - 4);
+    assert(outer_tpid(pkt) == ETHERTYPE_VLAN);
+    assert(packet_has_vlan_tag(pkt, &vid) && vid == 100);
+
+    // Nothing changes when the tag is already right
+    assert(vlan_process_egress_inplace(pkt, 100, 3) == STATUS_SUCCESS);
+    assert(pkt->size == FRAME_LEN + 4);
+
+    // An untagged member gets it popped again
+    assert(vlan_process_egress_inplace(pkt, 100, 4) == STATUS_SUCCESS);
+    assert(pkt->size == FRAME_LEN && !packet_has_vlan_tag(pkt, &vid));
+    assert(pkt->data[12] == 0x88 && pkt->data[13] == 0xB5 && pkt->data[14] == 0x5A);
+
+    // Non-members get nothing
+    assert(vlan_process_egress_inplace(pkt, 100, 5) == STATUS_INVALID_PORT);
+
+    // The copying variant leaves the source alone
+    assert(vlan_process_egress(pkt, 100, 3, out) == STATUS_SUCCESS);
+    assert(out->size == FRAME_LEN + 4 && packet_has_vlan_tag(out, &vid) && vid == 100);
+    assert(pkt->size == FRAME_LEN);
+    assert(vlan_process_egress(out, 100, 4, out) == STATUS_SUCCESS);
+    assert(out->size == FRAME_LEN && memcmp(out->data, pkt->data, FRAME_LEN) == 0);
+
+    // Egress translation sends the VLAN under another VID
+    assert(vlan_set_egress_translation(3, 100, 300) == STATUS_SUCCESS);
+    assert(vlan_process_egress_inplace(pkt, 100, 3) == STATUS_SUCCESS);
+    assert(packet_has_vlan_tag(pkt, &vid) && vid == 300);
+
+    assert(vlan_deinit() == STATUS_SUCCESS);
+    packet_buffer_free(out);
+    packet_buffer_free(pkt);
+    printf(TEST_PASSED, "test_vlan_egress_push_pop");
+}
+
+void test_vlan_qinq_push_pop() {
+    packet_buffer_t *pkt = make_frame(10);
+    vlan_id_t vlan_id = VLAN_ID_INVALID;
+    uint16_t s_tci = 0, c_tci = 0;
+
+    assert(vlan_init(NUM_PORTS) == STATUS_SUCCESS);
+    assert(vlan_create(200, "svlan") == STATUS_SUCCESS);
+    assert(vlan_add_port(200, 1, VLAN_MEMBER_UNTAGGED) == STATUS_SUCCESS);
+    assert(vlan_add_port(200, 9, VLAN_MEMBER_TAGGED) == STATUS_SUCCESS);
+    assert(vlan_set_port_qinq_mode(1, VLAN_QINQ_CUSTOMER) == STATUS_SUCCESS);
+    assert(vlan_set_port_qinq_mode(9, VLAN_QINQ_PROVIDER) == STATUS_SUCCESS);
+    assert(vlan_set_svlan_translation(1, 10, 200) == STATUS_SUCCESS);
+
+    // The customer C-tag is kept and an S-tag for the S-VLAN goes on top
+    assert(vlan_process_ingress_inplace(1, pkt, &vlan_id) == STATUS_SUCCESS);
+    assert(vlan_id == 200);
+    assert(pkt->size == FRAME_LEN + 8);
+    assert(outer_tpid(pkt) == ETHERTYPE_QINQ);
+
+    // The provider port sends it double tagged as is
+    assert(vlan_process_egress_inplace(pkt, 200, 9) == STATUS_SUCCESS);
+    assert(pkt->size == FRAME_LEN + 8 && outer_tpid(pkt) == ETHERTYPE_QINQ);
+    assert(packet_qinq_pop(pkt, &s_tci, &c_tci) == STATUS_SUCCESS);
+    assert((s_tci & 0x0FFF) == 200 && (c_tci & 0x0FFF) == 10);
+
+    // Back towards the customer the S-tag comes off and the C-tag stays
+    assert(packet_qinq_push(pkt, 200, 10) == STATUS_SUCCESS);
+    assert(vlan_process_egress_inplace(pkt, 200, 1) == STATUS_SUCCESS);
+    assert(pkt->size == FRAME_LEN + 4 && outer_tpid(pkt) == ETHERTYPE_VLAN);
+    assert(pkt->data[14] == 0x00 && pkt->data[15] == 10);
+
+    // S-tagged frames from a customer are dropped
+    assert(packet_vlan_push(pkt, ETHERTYPE_QINQ, 200) == STATUS_SUCCESS);
+    assert(vlan_process_ingress_inplace(1, pkt, &vlan_id) == ERROR_INVALID_PACKET);
+
+    assert(vlan_deinit() == STATUS_SUCCESS);
+    packet_buffer_free(pkt);
+    printf(TEST_PASSED, "test_vlan_qinq_push_pop");
+}
+
+void test_vlan_pages() {
+    vlan_id_t vlans[3];
+    table_cursor_t cursor = TABLE_CURSOR_START;
+    uint32_t count, total = 0, in_range = 0;
+    int last = -1;
+
+    assert(vlan_init(NUM_PORTS) == STATUS_SUCCESS);
+    assert(vlan_create_range(300, 310) == STATUS_SUCCESS);
+    assert(vlan_create(4000, NULL) == STATUS_SUCCESS);
+
+    // Pages come in ascending order with no VLAN twice
+    while (cursor != TABLE_CURSOR_END) {
+        assert(vlan_get_active_vlans_page(&cursor, vlans, 3, &count) == STATUS_SUCCESS);
+        assert(count <= 3);
+        for (uint32_t i = 0; i < count; i++) {
+            assert((int)vlans[i] > last);
+            last = vlans[i];
+            if (vlans[i] >= 300 && vlans[i] <= 310) {
+                in_range++;
+            }
         }
+        total += count;
     }
-    
-    assert(found_vlan100 && found_vlan200 && found_vlan300);
-    
-    vlan_table_destroy(&vlan_table);
-    printf(TEST_PASSED, "test_vlan_port_operations");
-}
+    assert(in_range == 11 && last == 4000 && total >= 12);
 
-void test_vlan_packet_processing() {
-    vlan_table_t vlan_table;
-    vlan_table_init(&vlan_table, 4096);
-    
-    // Setup VLAN configuration
-    vlan_create(&vlan_table, 100, "data_vlan");
-    vlan_create(&vlan_table, 200, "voice_vlan");
-    
-    // Port 1: Access port in VLAN 100
-    vlan_add_port(&vlan_table, 100, 1, VLAN_PORT_UNTAGGED);
-    
-    // Port 2: Trunk port allowing VLAN 100, 200
-    vlan_add_port(&vlan_table, 100, 2, VLAN_PORT_TAGGED);
-    vlan_add_port(&vlan_table, 200, 2, VLAN_PORT_TAGGED);
-    
-    // Port 3: Access port in VLAN 200
-    vlan_add_port(&vlan_table, 200, 3, VLAN_PORT_UNTAGGED);
-    
-    // Test packet classification
-    packet_t untagged_packet;
-    memset(&untagged_packet, 0, sizeof(packet_t));
-    untagged_packet.ingress_port = 1;
-    
-    uint32_t result = vlan_classify_packet(&vlan_table, &untagged_packet);
-    assert(result == SUCCESS);
-    assert(untagged_packet.vlan_id == 100);
-    
-    // Test packet with VLAN tag
-    packet_t tagged_packet;
-    memset(&tagged_packet, 0, sizeof(packet_t));
-    tagged_packet.ingress_port = 2;
-    tagged_packet.has_vlan_tag = true;
-    tagged_packet.vlan_id = 200;
-    
-    result = vlan_process_packet(&vlan_table, &tagged_packet);
-    assert(result == SUCCESS);
-    
-    // Test egress VLAN handling
-    result = vlan_process_egress(&vlan_table, &untagged_packet, 2);
-    assert(result == SUCCESS);
-    assert(untagged_packet.has_vlan_tag == true); // Should be tagged on trunk port
-    
-    result = vlan_process_egress(&vlan_table, &tagged_packet, 3);
-    assert(result == SUCCESS);
-    assert(tagged_packet.has_vlan_tag == false); // Should be untagged on access port
-    
-    vlan_table_destroy(&vlan_table);
-    printf(TEST_PASSED, "test_vlan_packet_processing");
+    // An ended walk stays ended, and an empty page is refused
+    assert(vlan_get_active_vlans_page(&cursor, vlans, 3, &count) == STATUS_SUCCESS);
+    assert(count == 0 && cursor == TABLE_CURSOR_END);
+    cursor = TABLE_CURSOR_START;
+    assert(vlan_get_active_vlans_page(&cursor, vlans, 0, &count) == ERROR_INVALID_PARAMETER);
+
+    // A cursor kept across a delete resumes after it
+    assert(vlan_get_active_vlans_page(&cursor, vlans, 3, &count) == STATUS_SUCCESS);
+    assert(vlan_delete(4000) == STATUS_SUCCESS);
+    last = vlans[count - 1];
+    while (cursor != TABLE_CURSOR_END) {
+        assert(vlan_get_active_vlans_page(&cursor, vlans, 3, &count) == STATUS_SUCCESS);
+        for (uint32_t i = 0; i < count; i++) {
+            assert((int)vlans[i] > last && vlans[i] != 4000);
+            last = vlans[i];
+        }
+    }
+    assert(last == 310);
+
+    assert(vlan_deinit() == STATUS_SUCCESS);
+    printf(TEST_PASSED, "test_vlan_pages");
 }
 
 int main() {
     printf("Running VLAN unit tests...\n");
-    
+
+    // Only ports the hardware simulation has can be VLAN members
+    assert(port_init() == STATUS_SUCCESS);
+    assert(packet_init() == STATUS_SUCCESS);
+
     test_vlan_create();
     test_vlan_delete();
+    test_vlan_range();
+    test_vlan_pages();
     test_port_vlan_membership();
-    test_vlan_port_operations();
-    test_vlan_packet_processing();
-    
+    test_vlan_ingress_classification();
+    test_vlan_egress_push_pop();
+    test_vlan_qinq_push_pop();
+
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
     printf("All VLAN tests completed successfully.\n");
     return 0;
 }
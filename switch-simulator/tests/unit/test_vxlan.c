@@ -0,0 +1,327 @@
+/**
+ * @file test_vxlan.c
+ * @brief Unit tests for the VXLAN tunnel endpoint
+ *
+ * A frame the VTEP encapsulates is turned around, addresses swapped, and
+ * fed back as if the remote VTEP had sent it.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "../../include/l2/vxlan.h"
+#include "../../include/hal/packet.h"
+#include "../../include/hal/packet_offload.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define LOCAL_IP 0x0A000001u            /* 10.0.0.1 */
+#define REMOTE_IP 0x0A000002u           /* 10.0.0.2 */
+#define OTHER_IP 0x0A000003u            /* 10.0.0.3 */
+#define UNDERLAY_PORT 3
+#define VLAN 10
+#define VNI 5000
+#define PAYLOAD_LEN 32
+#define INNER_LEN (14 + 20 + 8 + PAYLOAD_LEN)   /* Untagged */
+#define TAGGED_LEN (INNER_LEN + 4)
+#define MAX_COPIES 4
+
+static const mac_addr_t g_local_mac = { .addr = { 0x02, 0, 0, 0, 0, 0x01 } };
+static const mac_addr_t g_next_hop = { .addr = { 0x02, 0, 0, 0, 0, 0x02 } };
+
+/* Copies vxlan_flood() sent */
+typedef struct {
+    uint32_t count;
+    port_id_t ports[MAX_COPIES];
+    packet_buffer_t *copies[MAX_COPIES];
+} sent_t;
+
+static void capture(port_id_t underlay_port, packet_buffer_t *packet, void *arg) {
+    sent_t *sent = arg;
+
+    assert(sent->count < MAX_COPIES);
+    sent->ports[sent->count] = underlay_port;
+    sent->copies[sent->count++] = packet;
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static void ip_checksum(uint8_t *ip) {
+    uint16_t sum;
+
+    ip[10] = 0;
+    ip[11] = 0;
+    sum = packet_csum_fold(packet_csum_add(0, ip, 20));
+    ip[10] = (uint8_t)(sum >> 8);
+    ip[11] = (uint8_t)sum;
+}
+
+/* A UDP datagram between two hosts, in VLAN 10 when tagged */
+static void build_inner(uint8_t *frame, bool tagged) {
+    static const uint8_t macs[12] = { 0x02, 0, 0, 0, 0, 0xbb, 0x02, 0, 0, 0, 0, 0xaa };
+    uint8_t *p = frame + 12;
+    uint8_t *ip;
+
+    memcpy(frame, macs, sizeof(macs));
+    if (tagged) {
+        p[0] = 0x81;
+        p[1] = 0x00;
+        p[2] = 0;
+        p[3] = VLAN;
+        p += 4;
+    }
+    p[0] = 0x08;
+    p[1] = 0x00;
+    ip = p + 2;
+    memset(ip, 0, 20 + 8);
+    ip[0] = 0x45;
+    ip[3] = 20 + 8 + PAYLOAD_LEN;
+    ip[8] = 64;
+    ip[9] = 17;
+    put32(ip + 12, 0xC0A80001u);
+    put32(ip + 16, 0xC0A80002u);
+    ip_checksum(ip);
+    ip[20] = 0x30;
+    ip[21] = 0x39;
+    ip[22] = 0x00;
+    ip[23] = 0x35;
+    ip[25] = 8 + PAYLOAD_LEN;
+    for (uint32_t i = 0; i < PAYLOAD_LEN; i++) {
+        ip[28 + i] = (uint8_t)i;
+    }
+}
+
+static packet_buffer_t *make_packet(const uint8_t *data, uint32_t length) {
+    packet_buffer_t *packet = packet_buffer_alloc(length);
+
+    assert(packet != NULL);
+    assert(packet_append_data(packet, data, length) == STATUS_SUCCESS);
+    assert(packet_parse(packet) == STATUS_SUCCESS);
+    return packet;
+}
+
+/* Check the outer headers the VTEP pushed, and the inner frame behind them */
+static void check_encap(const uint8_t *frame, uint32_t length) {
+    uint8_t inner[INNER_LEN];
+    const uint8_t *ip = frame + 14;
+    const uint8_t *udp = ip + 20;
+
+    build_inner(inner, false);
+    assert(length == INNER_LEN + VXLAN_ENCAP_LEN);
+    assert(memcmp(frame, g_next_hop.addr, 6) == 0 && memcmp(frame + 6, g_local_mac.addr, 6) == 0);
+    assert(frame[12] == 0x08 && frame[13] == 0x00);
+    assert(ip[0] == 0x45 && ip[8] == VXLAN_DEFAULT_TTL && ip[9] == 17);
+    assert(((ip[2] << 8) | ip[3]) == length - 14);
+    assert(get32(ip + 12) == LOCAL_IP && get32(ip + 16) == REMOTE_IP);
+    assert(packet_csum_fold(packet_csum_add(0, ip, 20)) == 0);
+    assert(((udp[2] << 8) | udp[3]) == VXLAN_UDP_PORT);
+    assert(((udp[4] << 8) | udp[5]) == length - 34 && udp[6] == 0 && udp[7] == 0);
+    assert(udp[8] == 0x08 && (get32(udp + 12) >> 8) == VNI);
+    assert(memcmp(frame + VXLAN_ENCAP_LEN, inner, INNER_LEN) == 0);
+}
+
+/* Make an encapsulated frame look like it came from the remote VTEP */
+static void turn_around(uint8_t *frame) {
+    uint8_t *ip = frame + 14;
+    uint32_t src = get32(ip + 12);
+
+    memcpy(frame, g_local_mac.addr, 6);
+    memcpy(frame + 6, g_next_hop.addr, 6);
+    put32(ip + 12, get32(ip + 16));
+    put32(ip + 16, src);
+    ip_checksum(ip);
+}
+
+void test_vxlan_config() {
+    vxlan_tunnel_config_t config = { .remote_ip = REMOTE_IP, .underlay_port = UNDERLAY_PORT,
+                                     .next_hop_mac = g_next_hop };
+    vxlan_tunnel_config_t got;
+    vxlan_stats_t stats;
+    mac_addr_t multicast = { .addr = { 0x01, 0, 0x5e, 0, 0, 1 } };
+
+    assert(vxlan_tunnel_create(VXLAN_PORT_ID(0), &config) == STATUS_NOT_INITIALIZED);
+    assert(vxlan_get_stats(&stats) == STATUS_NOT_INITIALIZED);
+    assert(vxlan_init() == STATUS_SUCCESS);
+
+    assert(vxlan_set_vtep(LOCAL_IP, NULL, 0) == STATUS_INVALID_PARAMETER);
+    assert(vxlan_set_vtep(LOCAL_IP, &multicast, 0) == STATUS_INVALID_PARAMETER);
+    assert(vxlan_set_vtep(LOCAL_IP, &g_local_mac, 0) == STATUS_SUCCESS);
+
+    // Tunnels live on their own port IDs and need a unicast next hop
+    assert(vxlan_port_is_tunnel(VXLAN_PORT_ID(0)) && !vxlan_port_is_tunnel(UNDERLAY_PORT));
+    assert(vxlan_tunnel_create(UNDERLAY_PORT, &config) == STATUS_INVALID_PARAMETER);
+    config.dscp = 64;
+    assert(vxlan_tunnel_create(VXLAN_PORT_ID(0), &config) == STATUS_INVALID_PARAMETER);
+    config.dscp = 0;
+    config.next_hop_mac = multicast;
+    assert(vxlan_tunnel_create(VXLAN_PORT_ID(0), &config) == STATUS_INVALID_PARAMETER);
+    config.next_hop_mac = g_next_hop;
+    config.remote_ip = 0;
+    assert(vxlan_tunnel_create(VXLAN_PORT_ID(0), &config) == STATUS_INVALID_PARAMETER);
+    config.remote_ip = REMOTE_IP;
+
+    assert(vxlan_tunnel_create(VXLAN_PORT_ID(0), &config) == STATUS_SUCCESS);
+    assert(vxlan_tunnel_create(VXLAN_PORT_ID(0), &config) == STATUS_ALREADY_EXISTS);
+    assert(vxlan_tunnel_create(VXLAN_PORT_ID(1), &config) == STATUS_RESOURCE_BUSY);
+    config.remote_ip = OTHER_IP;
+    assert(vxlan_tunnel_create(VXLAN_PORT_ID(1), &config) == STATUS_SUCCESS);
+    assert(vxlan_tunnel_get_config(VXLAN_PORT_ID(0), &got) == STATUS_SUCCESS);
+    assert(got.remote_ip == REMOTE_IP && got.underlay_port == UNDERLAY_PORT);
+    assert(vxlan_tunnel_get_config(VXLAN_PORT_ID(2), &got) == STATUS_NOT_FOUND);
+
+    // One VNI per VLAN and one VLAN per VNI
+    assert(vxlan_map_vni(0, VLAN) == STATUS_INVALID_PARAMETER);
+    assert(vxlan_map_vni(VXLAN_VNI_MAX + 1, VLAN) == STATUS_INVALID_PARAMETER);
+    assert(vxlan_map_vni(VNI, 0) == STATUS_INVALID_PARAMETER);
+    assert(vxlan_map_vni(VNI, VLAN) == STATUS_SUCCESS);
+    assert(vxlan_map_vni(VNI, VLAN + 1) == STATUS_RESOURCE_BUSY);
+    assert(vxlan_map_vni(VNI + 1, VLAN) == STATUS_RESOURCE_BUSY);
+    assert(vxlan_vlan_vni(VLAN) == VNI && vxlan_vlan_vni(VLAN + 1) == 0);
+    assert(vxlan_unmap_vni(VNI + 1) == STATUS_NOT_FOUND);
+
+    assert(vxlan_set_flood(VXLAN_PORT_ID(2), VLAN, true) == STATUS_NOT_FOUND);
+    assert(vxlan_set_flood(VXLAN_PORT_ID(0), 0, true) == STATUS_INVALID_PARAMETER);
+
+    printf(TEST_PASSED, "test_vxlan_config");
+}
+
+void test_vxlan_encap_decap() {
+    uint8_t tagged[TAGGED_LEN];
+    uint8_t inner[INNER_LEN];
+    uint8_t frame[INNER_LEN + VXLAN_ENCAP_LEN];
+    vxlan_tunnel_stats_t tstats;
+    vxlan_stats_t stats;
+    packet_buffer_t *packet;
+    port_id_t port;
+    vlan_id_t vlan;
+
+    // The tag goes and the outer headers come from the tunnel's template
+    build_inner(tagged, true);
+    packet = make_packet(tagged, TAGGED_LEN);
+    assert(vxlan_encap(packet, VXLAN_PORT_ID(0), VLAN + 1, &port) == STATUS_NOT_FOUND);
+    assert(vxlan_encap(packet, VXLAN_PORT_ID(0), VLAN, &port) == STATUS_SUCCESS);
+    assert(port == UNDERLAY_PORT && packet->metadata.port == UNDERLAY_PORT);
+    assert(packet_chain_length(packet) == sizeof(frame));
+    assert(packet_peek_data(packet, 0, frame, sizeof(frame)) == STATUS_SUCCESS);
+    packet_buffer_free(packet);
+    check_encap(frame, sizeof(frame));
+    assert(vxlan_tunnel_get_stats(VXLAN_PORT_ID(0), &tstats) == STATUS_SUCCESS);
+    assert(tstats.encap_packets == 1 && tstats.encap_bytes == sizeof(frame));
+
+    // The same frame coming back is for the VTEP: the inner frame is left
+    turn_around(frame);
+    packet = make_packet(frame, sizeof(frame));
+    assert(vxlan_decap(packet, &port, &vlan) == STATUS_SUCCESS);
+    assert(port == VXLAN_PORT_ID(0) && vlan == VLAN);
+    build_inner(inner, false);
+    assert(packet_chain_length(packet) == INNER_LEN);
+    assert(memcmp(packet->data, inner, INNER_LEN) == 0);
+    assert(packet_has_proto(packet, PACKET_PROTO_IPV4));
+    packet_buffer_free(packet);
+    assert(vxlan_tunnel_get_stats(VXLAN_PORT_ID(0), &tstats) == STATUS_SUCCESS);
+    assert(tstats.decap_packets == 1 && tstats.decap_bytes == sizeof(frame));
+
+    // A frame that is not VXLAN to the VTEP is bridged as is
+    packet = make_packet(inner, INNER_LEN);
+    assert(vxlan_decap(packet, &port, &vlan) == STATUS_NOT_FOUND);
+    packet_buffer_free(packet);
+
+    // Unknown VNI, missing I flag, unknown remote VTEP
+    frame[14 + 20 + 8 + 6] ^= 0x01;
+    packet = make_packet(frame, sizeof(frame));
+    assert(vxlan_decap(packet, &port, &vlan) == STATUS_INVALID_PARAMETER);
+    packet_buffer_free(packet);
+    frame[14 + 20 + 8 + 6] ^= 0x01;
+    frame[14 + 20 + 8] = 0;
+    packet = make_packet(frame, sizeof(frame));
+    assert(vxlan_decap(packet, &port, &vlan) == STATUS_INVALID_PACKET);
+    packet_buffer_free(packet);
+    frame[14 + 20 + 8] = 0x08;
+    put32(frame + 14 + 12, 0x0A000009u);
+    ip_checksum(frame + 14);
+    packet = make_packet(frame, sizeof(frame));
+    assert(vxlan_decap(packet, &port, &vlan) == STATUS_PERMISSION_DENIED);
+    packet_buffer_free(packet);
+
+    assert(vxlan_get_stats(&stats) == STATUS_SUCCESS);
+    assert(stats.unknown_vni == 1 && stats.bad_header == 1 && stats.unknown_vtep == 1);
+    assert(stats.encap_errors == 0);
+
+    printf(TEST_PASSED, "test_vxlan_encap_decap");
+}
+
+void test_vxlan_flood() {
+    uint8_t tagged[TAGGED_LEN];
+    uint8_t frame[INNER_LEN + VXLAN_ENCAP_LEN];
+    sent_t sent = { 0 };
+    packet_buffer_t *packet;
+
+    assert(vxlan_set_flood(VXLAN_PORT_ID(0), VLAN, true) == STATUS_SUCCESS);
+    assert(vxlan_set_flood(VXLAN_PORT_ID(1), VLAN, true) == STATUS_SUCCESS);
+    build_inner(tagged, true);
+    packet = make_packet(tagged, TAGGED_LEN);
+
+    // One copy per tunnel; the flooded frame keeps its tag
+    assert(vxlan_flood(packet, VLAN, 1, capture, &sent) == 2);
+    assert(packet_chain_length(packet) == TAGGED_LEN);
+    for (uint32_t i = 0; i < sent.count; i++) {
+        assert(sent.ports[i] == UNDERLAY_PORT);
+        assert(packet_chain_length(sent.copies[i]) == sizeof(frame));
+        assert(packet_peek_data(sent.copies[i], 0, frame, sizeof(frame)) == STATUS_SUCCESS);
+        if (i == 0) {
+            check_encap(frame, sizeof(frame));
+        } else {
+            assert(get32(frame + 14 + 16) == OTHER_IP);
+        }
+        packet_buffer_free(sent.copies[i]);
+    }
+
+    // Split horizon, other VLANs, and tunnels taken off the list
+    sent.count = 0;
+    assert(vxlan_flood(packet, VLAN, VXLAN_PORT_ID(1), capture, &sent) == 0);
+    assert(vxlan_flood(packet, VLAN + 1, 1, capture, &sent) == 0);
+    assert(vxlan_set_flood(VXLAN_PORT_ID(1), VLAN, false) == STATUS_SUCCESS);
+    assert(vxlan_flood(packet, VLAN, 1, capture, &sent) == 1);
+    packet_buffer_free(sent.copies[0]);
+
+    // A deleted tunnel is off every flood list
+    assert(vxlan_tunnel_delete(VXLAN_PORT_ID(0)) == STATUS_SUCCESS);
+    assert(vxlan_tunnel_delete(VXLAN_PORT_ID(0)) == STATUS_NOT_FOUND);
+    sent.count = 0;
+    assert(vxlan_flood(packet, VLAN, 1, capture, &sent) == 0);
+    packet_buffer_free(packet);
+
+    assert(vxlan_unmap_vni(VNI) == STATUS_SUCCESS);
+    assert(vxlan_vlan_vni(VLAN) == 0);
+    assert(vxlan_deinit() == STATUS_SUCCESS);
+    assert(vxlan_deinit() == STATUS_NOT_INITIALIZED);
+
+    printf(TEST_PASSED, "test_vxlan_flood");
+}
+
+int main() {
+    printf("Running VXLAN unit tests...\n");
+
+    assert(packet_init() == STATUS_SUCCESS);
+
+    test_vxlan_config();
+    test_vxlan_encap_decap();
+    test_vxlan_flood();
+
+    assert(packet_shutdown() == STATUS_SUCCESS);
+
+    printf("All VXLAN tests completed successfully.\n");
+    return 0;
+}
@@ -0,0 +1,260 @@
+/**
+ * @file test_warm_restart.c
+ * @brief Unit tests for warm restart checkpoints
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "../../include/management/warm_restart.h"
+#include "../../include/l3/routing_table.h"
+#include "../../include/l3/arp.h"
+#include "../../include/l2/mac_table.h"
+#include "../../include/hal/port.h"
+#include "../../include/hal/hw_resources.h"
+#include "../../include/common/event_loop.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define MS 1000ULL
+
+static routing_table_t g_table;
+static char g_path[] = "/tmp/test_warm_restart_XXXXXX";
+
+static const mac_addr_t g_mac_a = { .addr = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x0A } };
+static const mac_addr_t g_mac_b = { .addr = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x0B } };
+static const mac_addr_t g_mac_c = { .addr = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x0C } };
+
+static ip_addr_t v4(const char *text) {
+    ip_addr_t addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.type = IP_TYPE_V4;
+    assert(inet_pton(AF_INET, text, &addr.addr.v4) == 1);
+    return addr;
+}
+
+static status_t add_route(const char *prefix, uint8_t prefix_len, const char *next_hop) {
+    ip_addr_t dest = v4(prefix);
+    ip_addr_t gw = v4(next_hop);
+
+    return routing_add_route(&dest, prefix_len, IP_TYPE_V4, &gw, 1, 1, ROUTE_TYPE_STATIC);
+}
+
+static bool has_route(const char *addr_text) {
+    ip_addr_t addr = v4(addr_text);
+    route_entry_t route;
+
+    return routing_lookup(&addr, IP_TYPE_V4, &route) == STATUS_SUCCESS;
+}
+
+static routing_table_stats_t route_stats(void) {
+    routing_table_stats_t stats;
+
+    assert(routing_table_get_stats(&stats) == STATUS_SUCCESS);
+    return stats;
+}
+
+static bool file_exists(const char *path) {
+    return access(path, F_OK) == 0;
+}
+
+static void stop_loop(event_timer_t *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+    event_loop_stop();
+}
+
+static void run_for(uint64_t ms) {
+    event_timer_t stop;
+
+    event_timer_init(&stop, stop_loop, NULL);
+    assert(event_timer_start(&stop, ms * MS, 0) == STATUS_SUCCESS);
+    assert(event_loop_run() == STATUS_SUCCESS);
+}
+
+/* What the simulator has learned before it goes down */
+static void populate(void) {
+    ipv4_addr_t ip_a = 0x0A000001;
+    ipv4_addr_t ip_b = 0x0A000002;
+
+    assert(add_route("10.1.0.0", 16, "192.0.2.1") == STATUS_SUCCESS);
+    assert(add_route("10.2.0.0", 16, "192.0.2.1") == STATUS_SUCCESS);
+    assert(add_route("10.3.0.0", 24, "192.0.2.2") == STATUS_SUCCESS);
+    assert(arp_add_entry(arp_table_get_instance(), &ip_a, &g_mac_a, 1) == STATUS_SUCCESS);
+    assert(arp_add_entry(arp_table_get_instance(), &ip_b, &g_mac_b, 2) == STATUS_SUCCESS);
+    assert(mac_table_add(g_mac_a, 1, 100, false) == STATUS_SUCCESS);
+    assert(mac_table_add(g_mac_b, 2, 100, false) == STATUS_SUCCESS);
+    assert(mac_table_add(g_mac_c, 3, 100, true) == STATUS_SUCCESS);
+}
+
+/* Everything the process held is gone */
+static void restart_tables(void) {
+    assert(routing_table_flush() == STATUS_SUCCESS);
+    assert(arp_deinit(arp_table_get_instance()) == STATUS_SUCCESS);
+    assert(arp_init(arp_table_get_instance()) == STATUS_SUCCESS);
+    assert(mac_table_deinit() == STATUS_SUCCESS);
+    assert(mac_table_init(1024, 300) == STATUS_SUCCESS);
+}
+
+void test_warm_restart_config() {
+    warm_restart_config_t config;
+
+    warm_restart_get_default_config(&config);
+    assert(config.stale_hold_ms == WARM_RESTART_DEFAULT_HOLD_MS);
+    assert(config.checkpoint_interval_ms == 0 && config.max_age_s == 0);
+
+    assert(warm_restart_restore(NULL) == STATUS_NOT_INITIALIZED);
+    assert(warm_restart_checkpoint(NULL) == STATUS_NOT_INITIALIZED);
+    assert(warm_restart_start() == STATUS_NOT_INITIALIZED);
+    assert(warm_restart_init(NULL, NULL) == STATUS_INVALID_PARAMETER);
+    assert(warm_restart_init("", NULL) == STATUS_INVALID_PARAMETER);
+
+    // Nothing saved yet is a cold start
+    assert(warm_restart_init(g_path, NULL) == STATUS_SUCCESS);
+    assert(warm_restart_restore(NULL) == STATUS_NOT_FOUND);
+    warm_restart_deinit();
+
+    printf(TEST_PASSED, "test_warm_restart_config");
+}
+
+void test_warm_restart_round_trip() {
+    warm_restart_config_t config;
+    warm_restart_stats_t stats;
+    ipv4_addr_t ip_a = 0x0A000001;
+    mac_addr_t mac;
+    uint16_t arp_port;
+    port_id_t port;
+    char tmp_path[sizeof(g_path) + 4];
+
+    warm_restart_get_default_config(&config);
+    config.stale_hold_ms = 30;
+    assert(warm_restart_init(g_path, &config) == STATUS_SUCCESS);
+    populate();
+
+    // Resolving a neighbor learns its MAC in the default VLAN as well; static
+    // MAC entries come back from the configuration, not the checkpoint
+    assert(warm_restart_checkpoint(&stats) == STATUS_SUCCESS);
+    assert(stats.routes == 3 && stats.arp_entries == 2 && stats.mac_entries == 4);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", g_path);
+    assert(file_exists(g_path) && !file_exists(tmp_path));
+
+    restart_tables();
+    assert(!has_route("10.1.2.3"));
+
+    // The tables come back before any protocol runs
+    assert(warm_restart_restore(&stats) == STATUS_SUCCESS);
+    assert(stats.routes == 3 && stats.routes_added == 3);
+    assert(stats.arp_entries == 2 && stats.mac_entries == 4);
+    assert(stats.age_s <= 1);
+    assert(has_route("10.1.2.3") && has_route("10.3.0.1"));
+    assert(arp_lookup(arp_table_get_instance(), &ip_a, &mac, &arp_port) == STATUS_SUCCESS);
+    assert(memcmp(&mac, &g_mac_a, sizeof(mac)) == 0 && arp_port == 1);
+    assert(mac_table_lookup(g_mac_b, 100, &port) == STATUS_SUCCESS && port == 2);
+    assert(mac_table_lookup(g_mac_c, 100, &port) != STATUS_SUCCESS);
+    assert(route_stats().stale_routes == 3);
+
+    // The protocols refresh one route in time; the others are swept
+    assert(add_route("10.2.0.0", 16, "192.0.2.1") == STATUS_ALREADY_EXISTS);
+    assert(route_stats().stale_routes == 2);
+    assert(warm_restart_start() == STATUS_SUCCESS);
+    run_for(config.stale_hold_ms + 20);
+    assert(route_stats().stale_routes == 0);
+    assert(has_route("10.2.1.1"));
+    assert(!has_route("10.1.2.3") && !has_route("10.3.0.1"));
+
+    warm_restart_deinit();
+    restart_tables();
+    unlink(g_path);
+    printf(TEST_PASSED, "test_warm_restart_round_trip");
+}
+
+void test_warm_restart_unusable() {
+    warm_restart_config_t config;
+    warm_restart_header_t header;
+    FILE *file;
+
+    warm_restart_get_default_config(&config);
+    config.checkpoint_interval_ms = 10;
+    assert(warm_restart_init(g_path, &config) == STATUS_SUCCESS);
+    assert(add_route("10.9.0.0", 16, "192.0.2.9") == STATUS_SUCCESS);
+
+    // Periodic checkpoints run off the event loop
+    assert(!file_exists(g_path));
+    assert(warm_restart_start() == STATUS_SUCCESS);
+    run_for(30);
+    assert(file_exists(g_path));
+    warm_restart_deinit();
+
+    // A checkpoint cut short is ignored
+    assert(truncate(g_path, sizeof(header) + 1) == 0);
+    assert(warm_restart_init(g_path, NULL) == STATUS_SUCCESS);
+    assert(warm_restart_restore(NULL) == STATUS_INVALID_PARAMETER);
+
+    // So is one written by another build
+    assert(warm_restart_checkpoint(NULL) == STATUS_SUCCESS);
+    file = fopen(g_path, "r+b");
+    assert(file != NULL);
+    assert(fread(&header, sizeof(header), 1, file) == 1);
+    header.route_record_size++;
+    assert(fseek(file, 0, SEEK_SET) == 0);
+    assert(fwrite(&header, sizeof(header), 1, file) == 1);
+    assert(fclose(file) == 0);
+    assert(warm_restart_restore(NULL) == STATUS_INVALID_PARAMETER);
+
+    // And one older than the limit
+    header.route_record_size--;
+    header.timestamp -= 3600;
+    file = fopen(g_path, "r+b");
+    assert(file != NULL);
+    assert(fwrite(&header, sizeof(header), 1, file) == 1);
+    assert(fclose(file) == 0);
+    config.checkpoint_interval_ms = 0;
+    config.max_age_s = 60;
+    assert(warm_restart_init(g_path, &config) == STATUS_SUCCESS);
+    assert(warm_restart_restore(NULL) == STATUS_INVALID_PARAMETER);
+    config.max_age_s = 0;
+    assert(warm_restart_init(g_path, &config) == STATUS_SUCCESS);
+    assert(warm_restart_restore(NULL) == STATUS_SUCCESS);
+
+    warm_restart_deinit();
+    restart_tables();
+    unlink(g_path);
+    printf(TEST_PASSED, "test_warm_restart_unusable");
+}
+
+int main() {
+    int fd;
+
+    printf("Running warm restart unit tests...\n");
+
+    // The checkpoint goes next to a name nobody else uses
+    fd = mkstemp(g_path);
+    assert(fd >= 0);
+    close(fd);
+    unlink(g_path);
+
+    assert(event_loop_init() == STATUS_SUCCESS);
+    assert(hw_resources_init() == STATUS_SUCCESS);
+    assert(port_init() == STATUS_SUCCESS);
+    assert(routing_table_init(&g_table) == STATUS_SUCCESS);
+    assert(arp_init(arp_table_get_instance()) == STATUS_SUCCESS);
+    assert(mac_table_init(1024, 300) == STATUS_SUCCESS);
+
+    test_warm_restart_config();
+    test_warm_restart_round_trip();
+    test_warm_restart_unusable();
+
+    assert(mac_table_deinit() == STATUS_SUCCESS);
+    assert(arp_deinit(arp_table_get_instance()) == STATUS_SUCCESS);
+    assert(routing_table_cleanup() == STATUS_SUCCESS);
+    assert(event_loop_shutdown() == STATUS_SUCCESS);
+
+    printf("All warm restart tests completed successfully.\n");
+    return 0;
+}
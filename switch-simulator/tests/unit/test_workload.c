@@ -0,0 +1,235 @@
+/**
+ * @file test_workload.c
+ * @brief Unit tests for workload files, RX recording and the egress digest
+ *
+ * Workload files are read back with the pcap replay, which is how a
+ * benchmark run consumes them.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "../../drivers/include/workload.h"
+#include "../../drivers/include/pcap_driver.h"
+#include "../../include/hal/hw_simulation.h"
+#include "../../include/hal/hw_resources.h"
+#include "../../include/hal/packet.h"
+#include "../../include/common/config.h"
+#include "../../include/common/error_codes.h"
+
+#define TEST_PASSED "[ PASSED ] %s\n"
+#define TEST_FAILED "[ FAILED ] %s: %s\n"
+
+#define FRAME_LEN 60
+#define MAX_FRAMES 8
+#define PORT_A 1
+#define PORT_B 2
+#define WAIT_POLLS 1000
+#define CONFIG_JSON "{\"vlans\":[10]}"
+
+static char g_path[] = "/tmp/test_workload_XXXXXX";
+
+/* A frame whose first payload byte tells it apart */
+static void make_frame(uint8_t *frame, uint8_t tag) {
+    memset(frame, 0, FRAME_LEN);
+    memset(frame, 0x02, 6);
+    memset(frame + 6, 0x04, 6);
+    frame[12] = 0x88;
+    frame[13] = 0xB5;
+    frame[14] = tag;
+}
+
+static packet_buffer_t *make_packet(uint8_t tag) {
+    uint8_t frame[FRAME_LEN];
+    packet_buffer_t *packet = packet_buffer_alloc(FRAME_LEN);
+
+    make_frame(frame, tag);
+    assert(packet != NULL);
+    assert(packet_append_data(packet, frame, FRAME_LEN) == STATUS_SUCCESS);
+    return packet;
+}
+
+static void bring_up(port_id_t port) {
+    port_config_t config;
+    port_state_t state;
+
+    // The simulated link comes up at random once the port is enabled
+    assert(hw_sim_get_port_config(port, &config) == STATUS_SUCCESS);
+    config.admin_state = true;
+    do {
+        assert(hw_sim_set_port_config(port, &config) == STATUS_SUCCESS);
+        assert(hw_sim_get_port_state(port, &state) == STATUS_SUCCESS);
+    } while (state != PORT_STATE_UP);
+}
+
+/* Take what the port received and return the tags in order */
+static uint32_t rx_tags(port_id_t port, uint8_t *tags) {
+    packet_buffer_t *pkts[MAX_FRAMES];
+    uint32_t n = hw_sim_rx_dequeue_burst(port, pkts, MAX_FRAMES);
+
+    for (uint32_t i = 0; i < n; i++) {
+        assert(pkts[i]->length == FRAME_LEN);
+        tags[i] = pkts[i]->data[14];
+        packet_buffer_free(pkts[i]);
+    }
+    return n;
+}
+
+/* Replay a workload into the ports its frames were recorded on */
+static void replay(const char *config) {
+    pcap_replay_config_t replay_config = { .timing = PCAP_REPLAY_MAX_RATE, .by_interface = true };
+    pcap_replay_stats_t stats;
+    pcap_replay_t *replay;
+    char comment[64];
+    size_t length;
+
+    assert(pcap_replay_open(g_path, &replay) == STATUS_SUCCESS);
+    assert(pcap_replay_get_comment(replay, comment, sizeof(comment), &length) == STATUS_SUCCESS);
+    assert(strcmp(comment, config) == 0 && length == strlen(config));
+    assert(pcap_replay_start(replay, &replay_config) == STATUS_SUCCESS);
+    for (int i = 0; i < WAIT_POLLS; i++) {
+        pcap_replay_get_stats(replay, &stats);
+        if (stats.done) {
+            break;
+        }
+        usleep(1000);
+    }
+    assert(stats.done && stats.skipped == 0);
+    pcap_replay_close(replay);
+}
+
+/* Send tagged frames out of a port and return the digest after */
+static void transmit(port_id_t port, const uint8_t *tags, uint32_t count, workload_digest_t *digest) {
+    packet_buffer_t *pkts[MAX_FRAMES];
+
+    for (uint32_t i = 0; i < count; i++) {
+        pkts[i] = make_packet(tags[i]);
+    }
+    assert(hw_sim_tx_enqueue_burst(port, pkts, count) == count);
+    hw_sim_tx_drain(port, 64);
+    workload_digest_get(digest);
+}
+
+void test_workload_writer() {
+    workload_writer_t *writer;
+    uint8_t frame[FRAME_LEN];
+    uint8_t tags[MAX_FRAMES];
+
+    assert(workload_writer_open(NULL, NULL, &writer) == STATUS_INVALID_PARAMETER);
+    assert(workload_writer_open("/nonexistent/dir/file", NULL, &writer) != STATUS_SUCCESS);
+    assert(workload_writer_open(g_path, CONFIG_JSON, &writer) == STATUS_SUCCESS);
+
+    // Port B's interface is declared first, as it receives first
+    make_frame(frame, 0xA0);
+    assert(workload_writer_add(writer, PORT_B, 1000, frame, FRAME_LEN) == STATUS_SUCCESS);
+    make_frame(frame, 0xA1);
+    assert(workload_writer_add(writer, PORT_A, 2000, frame, FRAME_LEN) == STATUS_SUCCESS);
+    make_frame(frame, 0xA2);
+    assert(workload_writer_add(writer, PORT_B, 3000, frame, FRAME_LEN) == STATUS_SUCCESS);
+    assert(workload_writer_add(writer, CONFIG_MAX_PORTS, 4000, frame, FRAME_LEN) == STATUS_INVALID_PARAMETER);
+    assert(workload_writer_add(writer, PORT_A, 4000, NULL, FRAME_LEN) == STATUS_INVALID_PARAMETER);
+    assert(workload_writer_close(writer) == STATUS_SUCCESS);
+    assert(workload_writer_close(NULL) == STATUS_SUCCESS);
+
+    // The configuration is the section comment; frames go back to their ports
+    replay(CONFIG_JSON);
+    assert(rx_tags(PORT_A, tags) == 1 && tags[0] == 0xA1);
+    assert(rx_tags(PORT_B, tags) == 2 && tags[0] == 0xA0 && tags[1] == 0xA2);
+
+    printf(TEST_PASSED, "test_workload_writer");
+}
+
+void test_workload_record() {
+    packet_buffer_t *pkts[MAX_FRAMES];
+    uint8_t tags[MAX_FRAMES];
+    uint64_t packets;
+
+    assert(workload_record_stop(&packets) == STATUS_NOT_INITIALIZED);
+    assert(workload_record_start(g_path, "{}") == STATUS_SUCCESS);
+    assert(workload_record_start(g_path, "{}") == STATUS_ALREADY_INITIALIZED);
+
+    // Everything the ports receive is written, in order
+    for (uint32_t i = 0; i < 3; i++) {
+        pkts[i] = make_packet((uint8_t)(0xB0 + i));
+    }
+    assert(hw_sim_rx_enqueue_burst(PORT_A, pkts, 3) == 3);
+    pkts[0] = make_packet(0xB3);
+    assert(hw_sim_rx_enqueue_burst(PORT_B, pkts, 1) == 1);
+    assert(workload_record_stop(&packets) == STATUS_SUCCESS);
+    assert(packets == 4);
+    assert(workload_record_stop(NULL) == STATUS_NOT_INITIALIZED);
+    assert(rx_tags(PORT_A, tags) == 3);
+    assert(rx_tags(PORT_B, tags) == 1);
+
+    // Nothing after the stop
+    pkts[0] = make_packet(0xBF);
+    assert(hw_sim_rx_enqueue_burst(PORT_A, pkts, 1) == 1);
+    assert(rx_tags(PORT_A, tags) == 1);
+
+    replay("{}");
+    assert(rx_tags(PORT_A, tags) == 3 && tags[0] == 0xB0 && tags[1] == 0xB1 && tags[2] == 0xB2);
+    assert(rx_tags(PORT_B, tags) == 1 && tags[0] == 0xB3);
+
+    printf(TEST_PASSED, "test_workload_record");
+}
+
+void test_workload_digest() {
+    static const uint8_t forward[4] = { 1, 2, 3, 4 };
+    static const uint8_t reverse[4] = { 4, 3, 2, 1 };
+    workload_digest_t first, second, other;
+
+    assert(workload_digest_start() == STATUS_SUCCESS);
+    assert(workload_digest_start() == STATUS_ALREADY_INITIALIZED);
+    transmit(PORT_A, forward, 2, &first);
+    transmit(PORT_B, forward + 2, 2, &first);
+    assert(first.packets == 4 && first.bytes == 4 * FRAME_LEN && first.value != 0);
+    workload_digest_stop();
+
+    // The same frames on the same ports in another order sum the same
+    assert(workload_digest_start() == STATUS_SUCCESS);
+    transmit(PORT_B, reverse, 2, &second);
+    transmit(PORT_A, reverse + 2, 2, &second);
+    assert(second.packets == 4 && second.value == first.value);
+    workload_digest_stop();
+
+    // A frame out of another port does not
+    assert(workload_digest_start() == STATUS_SUCCESS);
+    transmit(PORT_B, forward, 4, &other);
+    assert(other.packets == 4 && other.value != first.value);
+    workload_digest_stop();
+
+    // Stopped, the egress is no longer counted
+    transmit(PORT_A, forward, 1, &second);
+    assert(second.packets == other.packets && second.value == other.value);
+    workload_digest_stop();
+
+    printf(TEST_PASSED, "test_workload_digest");
+}
+
+int main() {
+    int fd;
+
+    printf("Running workload unit tests...\n");
+
+    fd = mkstemp(g_path);
+    assert(fd >= 0);
+    close(fd);
+
+    assert(packet_init() == STATUS_SUCCESS);
+    assert(hw_sim_init() == STATUS_SUCCESS);
+    bring_up(PORT_A);
+    bring_up(PORT_B);
+
+    test_workload_writer();
+    test_workload_record();
+    test_workload_digest();
+
+    assert(hw_sim_shutdown() == STATUS_SUCCESS);
+    assert(packet_shutdown() == STATUS_SUCCESS);
+    unlink(g_path);
+
+    printf("All workload tests completed successfully.\n");
+    return 0;
+}
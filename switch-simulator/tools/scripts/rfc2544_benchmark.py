@@ -0,0 +1,426 @@
+#!/usr/bin/env python3
+"""
+RFC 2544 benchmark driver for switch-simulator.
+
+Runs the throughput, latency, frame loss rate and back-to-back tests of
+RFC 2544 through the traffic generator: every trial is one generator run
+that sends UDP frames with latency probes on the TX interface and counts
+them on the RX interface, so a frame is lost when it was sent but its
+probe never came back. The generator writes its statistics as JSON and
+this script turns a series of trials into one result per frame size.
+
+Results are written as JSON for regression tracking; given a previous
+result file as --baseline, the script exits non-zero when the throughput
+of a frame size dropped by more than --regression-threshold percent.
+
+Example, with the device under test between veth0 and veth1:
+
+    sudo tools/scripts/rfc2544_benchmark.py --tx veth0 --rx veth1 \\
+        --line-rate 10000 --output results.json -- -d 02:00:00:00:00:02
+
+Arguments after -- are passed to every generator run.
+"""
+
+import os
+import sys
+import json
+import time
+import argparse
+import platform
+import tempfile
+import subprocess
+from datetime import datetime, timezone
+
+PROJECT_ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), "../.."))
+DEFAULT_GENERATOR = os.path.join(PROJECT_ROOT, "network-simulator")
+
+# RFC 2544 section 9.1 frame sizes, plus a jumbo frame
+DEFAULT_FRAME_SIZES = [64, 128, 256, 512, 1024, 1280, 1518, 9216]
+ALL_TESTS = ["throughput", "latency", "frame-loss", "back-to-back"]
+
+# Preamble, start of frame delimiter, FCS and inter-frame gap: the generator
+# sizes are frames without their FCS
+WIRE_OVERHEAD_BYTES = 24
+
+# Extra seconds a generator run may take over its trial, for the receiver drain
+TRIAL_SLACK_S = 10
+
+
+class BenchmarkError(Exception):
+    """A trial could not be run"""
+
+
+def parse_args():
+    """Parse the command line"""
+    parser = argparse.ArgumentParser(
+        description="RFC 2544 benchmark through the traffic generator",
+        epilog="Arguments after -- are passed to every generator run.")
+    parser.add_argument("--generator", default=DEFAULT_GENERATOR,
+                        help="Traffic generator binary (default: %(default)s)")
+    parser.add_argument("--tx", required=True, help="Interface to send on")
+    parser.add_argument("--rx", help="Interface to receive on (default: the TX interface)")
+    parser.add_argument("--tests", default=",".join(ALL_TESTS),
+                        help="Comma-separated tests to run (default: %(default)s)")
+    parser.add_argument("--sizes", default=",".join(str(s) for s in DEFAULT_FRAME_SIZES),
+                        help="Comma-separated frame sizes in bytes, 64-9216 (default: %(default)s)")
+    parser.add_argument("--line-rate", type=float,
+                        help="Line rate in Mbit/s (default: the TX interface speed, else 10000)")
+    parser.add_argument("--max-rate", type=int,
+                        help="Cap on the frame rate tried, in frames/s, for generators "
+                             "slower than the line rate")
+    parser.add_argument("--trial-duration", type=int, default=10,
+                        help="Seconds per throughput, latency and frame loss trial "
+                             "(RFC 2544 asks for 60, default: %(default)s)")
+    parser.add_argument("--resolution", type=float, default=0.5,
+                        help="Throughput search resolution, percent of line rate (default: %(default)s)")
+    parser.add_argument("--loss-tolerance", type=float, default=0.0,
+                        help="Loss in percent still counted as no loss (default: %(default)s)")
+    parser.add_argument("--latency-trials", type=int, default=20,
+                        help="Latency trials per frame size (default: %(default)s)")
+    parser.add_argument("--frame-loss-step", type=float, default=10.0,
+                        help="Frame loss rate step, percent of line rate (default: %(default)s)")
+    parser.add_argument("--b2b-duration", type=float, default=2.0,
+                        help="Longest burst tried, in seconds at line rate (default: %(default)s)")
+    parser.add_argument("--b2b-trials", type=int, default=50,
+                        help="Back-to-back trials per frame size (default: %(default)s)")
+    parser.add_argument("--threads", type=int, default=1,
+                        help="Generator threads for the rate tests (default: %(default)s)")
+    parser.add_argument("--mmap", action="store_true", help="Send through the generator TX ring")
+    parser.add_argument("--output", help="Write the results as JSON to this file")
+    parser.add_argument("--baseline", help="Previous results to compare throughput with")
+    parser.add_argument("--regression-threshold", type=float, default=5.0,
+                        help="Throughput drop against the baseline, in percent, "
+                             "that fails the run (default: %(default)s)")
+    parser.add_argument("--verbose", "-v", action="store_true", help="Print every trial")
+
+    argv = sys.argv[1:]
+    extra = []
+    if "--" in argv:
+        split = argv.index("--")
+        argv, extra = argv[:split], argv[split + 1:]
+    args = parser.parse_args(argv)
+    args.generator_args = extra
+
+    args.rx = args.rx or args.tx
+    args.tests = [t.strip() for t in args.tests.split(",") if t.strip()]
+    for test in args.tests:
+        if test not in ALL_TESTS:
+            parser.error(f"unknown test {test}, expected one of {', '.join(ALL_TESTS)}")
+    try:
+        args.sizes = [int(s) for s in args.sizes.split(",")]
+    except ValueError:
+        parser.error("frame sizes must be integers")
+    for size in args.sizes:
+        if size < 64 or size > 9216:
+            parser.error(f"frame size {size} is outside 64-9216")
+    if args.line_rate is None:
+        args.line_rate = interface_speed(args.tx) or 10000.0
+    if args.line_rate <= 0 or args.trial_duration <= 0 or args.resolution <= 0:
+        parser.error("line rate, trial duration and resolution must be positive")
+    return args
+
+
+def interface_speed(interface):
+    """Link speed of an interface in Mbit/s, None if the kernel does not know it"""
+    try:
+        with open(f"/sys/class/net/{interface}/speed") as f:
+            speed = int(f.read().strip())
+    except (OSError, ValueError):
+        return None
+    return float(speed) if speed > 0 else None
+
+
+def line_rate_fps(args, size):
+    """Frames per second at line rate for a frame size"""
+    return args.line_rate * 1e6 / ((size + WIRE_OVERHEAD_BYTES) * 8)
+
+
+def max_rate_fps(args, size):
+    """Highest frame rate tried for a frame size"""
+    rate = int(line_rate_fps(args, size))
+    if args.max_rate:
+        rate = min(rate, args.max_rate)
+    return max(rate, 1)
+
+
+def run_trial(args, size, rate, duration=None, count=None, threads=None, burst=None):
+    """Run the generator once and return the sent, received and latency figures"""
+    with tempfile.NamedTemporaryFile(prefix="rfc2544-", suffix=".json", delete=False) as f:
+        json_path = f.name
+
+    command = [args.generator, "-i", args.tx, "-R", args.rx, "-P", "1", "-L",
+               "-s", str(size), "-r", str(int(rate)), "-T", str(threads or args.threads),
+               "--json", json_path]
+    if duration:
+        command += ["-t", str(duration)]
+    if count:
+        command += ["-n", str(count)]
+    if burst:
+        command += ["-b", str(burst)]
+    if args.mmap:
+        command.append("-m")
+    command += args.generator_args
+
+    timeout = (duration or 0) + TRIAL_SLACK_S
+    if count:
+        timeout += count / rate
+    try:
+        result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                                universal_newlines=True, timeout=timeout)
+        if result.returncode != 0:
+            raise BenchmarkError(f"generator exited with {result.returncode}: {result.stderr.strip()}")
+        with open(json_path) as f:
+            stats = json.load(f)
+    except subprocess.TimeoutExpired:
+        raise BenchmarkError(f"generator did not finish within {timeout:.0f} s")
+    except (OSError, ValueError) as e:
+        raise BenchmarkError(f"no statistics from the generator: {e}")
+    finally:
+        if os.path.exists(json_path):
+            os.unlink(json_path)
+
+    sent = stats["sent"]["packets"]
+    received = stats.get("received", {}).get("probes", 0)
+    # Frames the receiver never saw do not show up as sequence gaps at the end
+    lost = max(sent - received, 0)
+    trial = {
+        "size": size,
+        "offered_fps": int(rate),
+        "sent_fps": sent / duration if duration else None,
+        "sent": sent,
+        "received": received,
+        "lost": lost,
+        "loss_pct": 100.0 * lost / sent if sent else 100.0,
+        "latency_ns": stats.get("latency_ns"),
+        "jitter_ns": stats.get("jitter_ns"),
+    }
+    if args.verbose:
+        print(f"    {size:5d} B  {int(rate):9d} fps  sent {sent}  received {received}  "
+              f"loss {trial['loss_pct']:.4f}%")
+    return trial
+
+
+def passed(args, trial):
+    """Whether a trial lost no more than the tolerance"""
+    return trial["sent"] > 0 and trial["loss_pct"] <= args.loss_tolerance
+
+
+def test_throughput(args, size):
+    """Highest rate without loss, by binary search (RFC 2544 section 26.1)"""
+    top = max_rate_fps(args, size)
+    step = max(int(top * args.resolution / 100.0), 1)
+    best = None
+    trials = 0
+
+    # Most runs pass at the top rate or fail far below it, so try it first
+    trial = run_trial(args, size, top, duration=args.trial_duration)
+    trials += 1
+    if passed(args, trial):
+        best = trial
+    else:
+        low, high = 0, top
+        while high - low > step:
+            rate = (low + high) // 2
+            trial = run_trial(args, size, rate, duration=args.trial_duration)
+            trials += 1
+            if passed(args, trial):
+                low, best = rate, trial
+            else:
+                high = rate
+
+    fps = best["offered_fps"] if best else 0
+    return {
+        "fps": fps,
+        "mbps": fps * size * 8 / 1e6,
+        "line_rate_pct": 100.0 * fps / line_rate_fps(args, size),
+        "trials": trials,
+        # Below fps when the generator could not keep up with the offered rate
+        "sent_fps": best["sent_fps"] if best else None,
+        "loss_pct_at_rate": best["loss_pct"] if best else None,
+    }
+
+
+def test_latency(args, size, rate):
+    """Latency at the throughput rate, averaged over trials (RFC 2544 section 26.2)"""
+    if rate <= 0:
+        return None
+    samples = []
+    for _ in range(args.latency_trials):
+        trial = run_trial(args, size, rate, duration=args.trial_duration)
+        if trial["latency_ns"] and trial["latency_ns"]["count"] > 0:
+            samples.append(trial)
+    if not samples:
+        return None
+
+    def mean(key):
+        return sum(t["latency_ns"][key] for t in samples) / len(samples)
+
+    return {
+        "rate_fps": rate,
+        "trials": len(samples),
+        "mean_ns": mean("mean"),
+        "p50_ns": mean("p50"),
+        "p90_ns": mean("p90"),
+        "p99_ns": mean("p99"),
+        "p99_9_ns": mean("p99_9"),
+        "min_ns": min(t["latency_ns"]["min"] for t in samples),
+        "max_ns": max(t["latency_ns"]["max"] for t in samples),
+        "jitter_ns": sum(t["jitter_ns"] or 0.0 for t in samples) / len(samples),
+    }
+
+
+def test_frame_loss(args, size):
+    """Loss from line rate down until two steps lose nothing (RFC 2544 section 26.3)"""
+    points = []
+    clean = 0
+    pct = 100.0
+    while pct > 0 and clean < 2:
+        rate = max(int(line_rate_fps(args, size) * pct / 100.0), 1)
+        if args.max_rate and rate > args.max_rate:
+            pct -= args.frame_loss_step
+            continue
+        trial = run_trial(args, size, rate, duration=args.trial_duration)
+        points.append({"line_rate_pct": pct, "fps": rate, "loss_pct": trial["loss_pct"]})
+        clean = clean + 1 if trial["lost"] == 0 else 0
+        pct -= args.frame_loss_step
+    return points
+
+
+def burst_passed(args, size, rate, frames):
+    """Whether a burst of frames got through whole"""
+    trial = run_trial(args, size, rate, count=frames, threads=1, burst=frames)
+    return trial["sent"] == frames and trial["lost"] == 0
+
+
+def test_back_to_back(args, size):
+    """Longest burst at line rate without loss, averaged over trials (RFC 2544 section 26.4)"""
+    rate = max_rate_fps(args, size)
+    longest = max(int(rate * args.b2b_duration), 1)
+    bursts = []
+    for _ in range(args.b2b_trials):
+        # A burst is one pacer bucket, so the generator lets it go without gaps
+        if burst_passed(args, size, rate, longest):
+            best = longest
+        else:
+            low, high = 0, longest
+            step = max(longest // 1000, 1)
+            while high - low > step:
+                frames = (low + high) // 2
+                if burst_passed(args, size, rate, frames):
+                    low = frames
+                else:
+                    high = frames
+            best = low
+        bursts.append(best)
+    return {
+        "rate_fps": rate,
+        "trials": len(bursts),
+        "mean_frames": sum(bursts) / len(bursts),
+        "min_frames": min(bursts),
+        "max_frames": max(bursts),
+    }
+
+
+def compare_baseline(results, path, threshold):
+    """Throughput regressions against a previous result file"""
+    with open(path) as f:
+        baseline = json.load(f)
+    previous = {r["size"]: r for r in baseline.get("results", [])}
+    regressions = []
+    for result in results:
+        before = previous.get(result["size"], {}).get("throughput")
+        after = result.get("throughput")
+        if not before or not after or before["fps"] == 0:
+            continue
+        drop = 100.0 * (before["fps"] - after["fps"]) / before["fps"]
+        if drop > threshold:
+            regressions.append({"size": result["size"], "baseline_fps": before["fps"],
+                                "fps": after["fps"], "drop_pct": drop})
+    return regressions
+
+
+def print_summary(results):
+    """Print a table of the results"""
+    print(f"\n{'Size':>6} {'Throughput fps':>15} {'Mbit/s':>10} {'% line':>7} "
+          f"{'p50 us':>9} {'p99 us':>9} {'B2B frames':>11}")
+    for r in results:
+        tput = r.get("throughput") or {}
+        lat = r.get("latency") or {}
+        b2b = r.get("back_to_back") or {}
+        row = f"{r['size']:>6}"
+        row += f" {tput['fps']:>15}" if tput else f" {'-':>15}"
+        row += f" {tput['mbps']:>10.1f} {tput['line_rate_pct']:>7.2f}" if tput else f" {'-':>10} {'-':>7}"
+        row += f" {lat['p50_ns'] / 1000:>9.2f} {lat['p99_ns'] / 1000:>9.2f}" if lat else f" {'-':>9} {'-':>9}"
+        row += f" {b2b['mean_frames']:>11.0f}" if b2b else f" {'-':>11}"
+        print(row)
+
+
+def main():
+    args = parse_args()
+    if not os.access(args.generator, os.X_OK):
+        print(f"Traffic generator not found: {args.generator}", file=sys.stderr)
+        return 2
+
+    started = time.time()
+    results = []
+    try:
+        for size in args.sizes:
+            print(f"Frame size {size} bytes")
+            result = {"size": size, "line_rate_fps": line_rate_fps(args, size)}
+            throughput_fps = None
+            if "throughput" in args.tests or "latency" in args.tests:
+                result["throughput"] = test_throughput(args, size)
+                throughput_fps = result["throughput"]["fps"]
+                print(f"  throughput: {throughput_fps} fps "
+                      f"({result['throughput']['line_rate_pct']:.2f}% of line rate)")
+            if "latency" in args.tests:
+                result["latency"] = test_latency(args, size, throughput_fps)
+                if result["latency"]:
+                    print(f"  latency: p50 {result['latency']['p50_ns'] / 1000:.2f} us, "
+                          f"p99 {result['latency']['p99_ns'] / 1000:.2f} us")
+            if "frame-loss" in args.tests:
+                result["frame_loss"] = test_frame_loss(args, size)
+                print(f"  frame loss: {len(result['frame_loss'])} rates")
+            if "back-to-back" in args.tests:
+                result["back_to_back"] = test_back_to_back(args, size)
+                print(f"  back-to-back: {result['back_to_back']['mean_frames']:.0f} frames")
+            results.append(result)
+    except BenchmarkError as e:
+        print(f"Benchmark stopped: {e}", file=sys.stderr)
+        return 2
+    except KeyboardInterrupt:
+        print("Benchmark interrupted", file=sys.stderr)
+        return 130
+
+    report = {
+        "timestamp": datetime.now(timezone.utc).isoformat(),
+        "host": platform.node(),
+        "tx": args.tx,
+        "rx": args.rx,
+        "line_rate_mbps": args.line_rate,
+        "trial_duration_s": args.trial_duration,
+        "loss_tolerance_pct": args.loss_tolerance,
+        "generator_args": args.generator_args,
+        "elapsed_s": time.time() - started,
+        "results": results,
+    }
+
+    status = 0
+    if args.baseline:
+        report["regressions"] = compare_baseline(results, args.baseline, args.regression_threshold)
+        for reg in report["regressions"]:
+            print(f"Regression at {reg['size']} bytes: {reg['fps']} fps, "
+                  f"{reg['drop_pct']:.1f}% below {reg['baseline_fps']}", file=sys.stderr)
+        if report["regressions"]:
+            status = 1
+
+    print_summary(results)
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(report, f, indent=2)
+        print(f"\nResults written to {args.output}")
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())
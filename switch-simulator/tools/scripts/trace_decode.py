@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""
+Decoder for switch-simulator binary trace files (CLI "trace dump").
+
+Prints the records in time order as text, or with --json writes them in
+the Chrome trace event format, which Perfetto (ui.perfetto.dev) and
+chrome://tracing open. The file layout is described in
+include/common/trace.h.
+"""
+
+import argparse
+import json
+import socket
+import struct
+import sys
+
+MAGIC = b"SWTRACE1"
+HEADER = struct.Struct("<8sIIQQQd")
+RECORD = struct.Struct("<QHHIQQ")
+NAME_MAX = 24
+
+STP_ROLES = ["disabled", "root", "designated", "alternate", "backup"]
+STP_STATES = ["disabled", "blocking", "listening", "learning", "forwarding"]
+ARP_STATES = ["incomplete", "reachable", "stale", "delay", "probe", "failed"]
+
+
+def mac_vlan(value):
+    """MAC address and VLAN packed by trace_mac_arg()"""
+    mac = ":".join("%02x" % ((value >> (8 * (5 - i))) & 0xFF) for i in range(6))
+    return mac, value >> 48
+
+
+def address(version, a1, a2):
+    """Address bytes as stored, over a1 and a2"""
+    raw = struct.pack("<QQ", a1, a2)
+    if version == 6:
+        return socket.inet_ntop(socket.AF_INET6, raw)
+    return socket.inet_ntop(socket.AF_INET, raw[:4])
+
+
+def name_of(names, value):
+    return names[value] if value < len(names) else str(value)
+
+
+def event_args(name, a0, a1, a2):
+    """Arguments of a known event as a dict, raw words otherwise"""
+    if name in ("mac-learn", "mac-move", "mac-remove"):
+        mac, vlan = mac_vlan(a1)
+        args = {"mac": mac, "vlan": vlan, "port": a0}
+        if name == "mac-learn":
+            args["static"] = bool(a2)
+        elif name == "mac-move":
+            args["from_port"] = a2
+        else:
+            args["aged"] = bool(a2)
+        return args
+    if name in ("route-add", "route-remove"):
+        version = (a0 >> 8) & 0xFF
+        return {"vrf": a0 >> 16,
+                "prefix": "%s/%d" % (address(version, a1, a2), a0 & 0xFF)}
+    if name == "arp-state":
+        version = (a0 >> 8) & 0xFF
+        return {"address": address(version, a1, a2), "port": a0 >> 16,
+                "state": name_of(ARP_STATES, a0 & 0xFF)}
+    if name == "stp-role":
+        return {"port": a0, "from": name_of(STP_ROLES, a1), "to": name_of(STP_ROLES, a2)}
+    if name == "stp-state":
+        return {"port": a0, "from": name_of(STP_STATES, a1), "to": name_of(STP_STATES, a2)}
+    return {"a0": a0, "a1": a1, "a2": a2}
+
+
+def read_trace(path):
+    """Header fields, event names and records sorted by time"""
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) < HEADER.size:
+        raise ValueError("file too short for a trace header")
+    (magic, record_size, event_count, record_count,
+     start_tsc, start_ns, ticks_per_ns) = HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        raise ValueError("not a switch-simulator trace file")
+    if record_size != RECORD.size:
+        raise ValueError("unsupported record size %d" % record_size)
+
+    offset = HEADER.size
+    names = []
+    for _ in range(event_count):
+        names.append(data[offset:offset + NAME_MAX].split(b"\0", 1)[0].decode())
+        offset += NAME_MAX
+
+    records = []
+    for _ in range(record_count):
+        if offset + RECORD.size > len(data):
+            raise ValueError("file truncated")
+        tsc, event, ring, a0, a1, a2 = RECORD.unpack_from(data, offset)
+        offset += RECORD.size
+        # Cycle counters of different cores may differ slightly; the
+        # calibration is good enough to order events of different threads
+        ns = start_ns + (int((tsc - start_tsc) / ticks_per_ns) if ticks_per_ns > 0 else 0)
+        name = names[event] if event < len(names) else "event-%d" % event
+        records.append((ns, ring, name, event_args(name, a0, a1, a2)))
+    records.sort(key=lambda r: r[0])
+    return names, records
+
+
+def print_text(records, out):
+    for ns, ring, name, args in records:
+        sec, frac = divmod(ns, 1000000000)
+        fields = " ".join("%s=%s" % (k, v) for k, v in args.items())
+        out.write("%d.%09d ring %-3d %-13s %s\n" % (sec, frac, ring, name, fields))
+
+
+def write_json(records, out):
+    """Chrome trace event format: one instant event per record, a thread per ring"""
+    events = []
+    # Relative microseconds keep the sub-microsecond digits in a double
+    start = records[0][0] if records else 0
+    for ring in sorted({r[1] for r in records}):
+        events.append({"ph": "M", "name": "thread_name", "pid": 1, "tid": ring,
+                       "args": {"name": "ring %d" % ring}})
+    for ns, ring, name, args in records:
+        events.append({"ph": "i", "s": "t", "name": name, "cat": name.split("-")[0],
+                       "pid": 1, "tid": ring, "ts": (ns - start) / 1000.0, "args": args})
+    json.dump({"traceEvents": events, "displayTimeUnit": "ns"}, out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode a switch-simulator trace file")
+    parser.add_argument("trace", help="File written by the CLI command \"trace dump\"")
+    parser.add_argument("--json", metavar="FILE",
+                        help="Write Chrome trace event JSON for Perfetto, - for stdout")
+    parser.add_argument("--event", action="append",
+                        help="Only show this event, may be repeated")
+    args = parser.parse_args()
+
+    try:
+        _, records = read_trace(args.trace)
+    except (OSError, ValueError) as e:
+        sys.stderr.write("%s: %s\n" % (args.trace, e))
+        return 1
+    if args.event:
+        records = [r for r in records if r[2] in args.event]
+
+    if args.json:
+        if args.json == "-":
+            write_json(records, sys.stdout)
+        else:
+            with open(args.json, "w") as out:
+                write_json(records, out)
+    else:
+        print_text(records, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
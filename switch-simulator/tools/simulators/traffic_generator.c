@@ -4,6 +4,36 @@
  *
  * This module generates various types of network traffic patterns to test
  * the switch simulator under different load conditions and scenarios.
+ *
+ * By default each packet is built and sent with its own sendto(). With
+ * --mmap every thread instead gets a TPACKET_V3 TX ring whose frames are
+ * built once; per packet only the IP ID and TCP sequence number are
+ * patched, and the kernel is kicked once per batch. --qdisc-bypass hands
+ * frames straight to the driver, skipping the interface qdisc.
+ *
+ * --template builds the headers once for the sendto() path as well.
+ * Field modifiers (-F) then vary addresses, ports and the VLAN ID of the
+ * template per packet, fixing up the checksums incrementally, to spread
+ * the traffic over many flows.
+ *
+ * Sending is paced by a token bucket on CLOCK_MONOTONIC: each thread
+ * gets its share of the total rate, may send up to the burst size (-b)
+ * back to back, and sleeps with clock_nanosleep() to an absolute time,
+ * spinning for the last stretch. Packet sizes can follow IMIX or a
+ * custom weighted mix (-z), in a fixed order so runs are repeatable.
+ *
+ * --latency stamps a sequence number and a CLOCK_MONOTONIC send time
+ * into every payload with room for it. A receiver thread (--rx), in the
+ * same instance or in a second one on the same host (--rx-only), turns
+ * them into one-way latency, jitter, loss and reordering, with latency
+ * percentiles from an HDR histogram, in text and optionally JSON.
+ *
+ * Receiving keeps up with the generated load: every receive thread
+ * (--rx-threads) has its own socket with a TPACKET_V3 RX ring, the
+ * sockets share a PACKET_FANOUT group that spreads frames by flow hash
+ * or by receiving CPU (--rx-fanout), and each thread validates a whole
+ * ring block of frames at a time, taking receive times from the kernel
+ * timestamps of the frames.
  */
 
 #include <stdio.h>
@@ -24,13 +54,56 @@
 #include <net/if.h>
 #include <linux/if_packet.h>
 #include <pthread.h>
+#include <getopt.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Long-only options */
+#define OPT_RX_ONLY 1000
+#define OPT_JSON 1001
+#define OPT_RX_THREADS 1002
+#define OPT_RX_FANOUT 1003
 
 /* Configuration parameters */
-#define MAX_PACKET_SIZE 9000
+#define MAX_PACKET_SIZE 9216
 #define MIN_PACKET_SIZE 64
 #define DEFAULT_PACKET_SIZE 512
 #define MAX_THREADS 16
 
+/* TX ring (--mmap) parameters */
+#define TX_RING_FRAMES 4096   /* Frames in each thread's ring */
+#define TX_RING_BATCH 256     /* Most frames queued per kick */
+
+/* Field modifiers */
+#define MAX_MODIFIERS 8
+
+/* Pacing */
+#define DEFAULT_BURST 32           /* Packets a thread may send back to back */
+#define PACE_SPIN_NS 50000ULL      /* Waits shorter than this spin instead of sleeping */
+
+/* Packet size mixes */
+#define MAX_SIZE_CLASSES 16
+#define MAX_SIZE_WEIGHT 4096       /* Sum of the weights of a mix */
+
+/* Latency measurement */
+#define PROBE_MAGIC 0x54474c50     /* "TGLP" */
+#define RX_DRAIN_MS 500            /* Receiving goes on this long after sending stops */
+#define HIST_SUB_BUCKET_BITS 11    /* 3 significant digits */
+#define HIST_SUB_BUCKETS (1u << HIST_SUB_BUCKET_BITS)
+#define HIST_HALF (HIST_SUB_BUCKETS / 2)
+#define HIST_MAX_SHIFT 40          /* Values up to about 2^51 ns */
+#define HIST_COUNTS (HIST_SUB_BUCKETS + HIST_MAX_SHIFT * HIST_HALF)
+
+/* RX rings (--rx) */
+#define RX_RING_BLOCK_SIZE (1u << 20)  /* Bytes of one ring block */
+#define RX_RING_BLOCKS 32              /* Blocks in each receive thread's ring */
+#define RX_RING_FRAME_SIZE 2048        /* Nominal frame slot; V3 packs frames tighter */
+#define RX_RING_RETIRE_MS 4            /* A partly filled block is handed over after this */
+
 /* Traffic patterns */
 typedef enum {
     TRAFFIC_CONSTANT,     /* Constant bit rate */
@@ -50,14 +123,46 @@ typedef enum {
     PROTO_ARP             /* ARP packets */
 } protocol_type_t;
 
+/* Template fields a modifier can vary */
+typedef enum {
+    FIELD_SRC_MAC,
+    FIELD_DST_MAC,
+    FIELD_SRC_IP,
+    FIELD_DST_IP,
+    FIELD_SRC_PORT,
+    FIELD_DST_PORT,
+    FIELD_VLAN
+} field_id_t;
+
+/* How a modifier picks the value of each packet */
+typedef enum {
+    MODIFIER_INC,         /* Base, base + 1, ... base + count - 1, then again */
+    MODIFIER_RANDOM       /* Random in [base, base + count) */
+} modifier_mode_t;
+
+/* Per-packet variation of one template field over count values from its configured base */
+typedef struct {
+    field_id_t field;
+    modifier_mode_t mode;
+    uint32_t count;
+} field_modifier_t;
+
+/* One size of a packet size mix and its share */
+typedef struct {
+    unsigned int size;
+    unsigned int weight;
+} size_class_t;
+
 /* Traffic generator configuration */
 typedef struct {
     char interface[IFNAMSIZ];          /* Interface name to send traffic on */
     unsigned int packet_size;          /* Size of each packet */
-    unsigned long packets_per_sec;     /* Rate of packet transmission */
+    unsigned long packets_per_sec;     /* Rate of packet transmission, of all threads together */
+    unsigned int burst;                /* Packets a thread may send back to back */
     traffic_pattern_t pattern;         /* Traffic pattern to use */
     protocol_type_t protocol;          /* Protocol to use */
     unsigned int duration;             /* Duration in seconds (0 = infinite) */
+    unsigned long count;               /* Packets to send, of all threads together (0 = no limit) */
     unsigned int num_threads;          /* Number of generator threads */
     
     /* Destination information */
@@ -72,6 +177,21 @@ typedef struct {
     uint16_t vlan_id;                  /* VLAN ID (if using VLAN protocol) */
     uint8_t vlan_priority;             /* VLAN priority */
     
+    /* Transmit path */
+    int use_mmap;                      /* Send through a TPACKET_V3 TX ring */
+    int qdisc_bypass;                  /* Set PACKET_QDISC_BYPASS on the socket */
+    int use_template;                  /* Build headers once and patch them per packet */
+    int latency;                       /* Stamp latency probes into the payloads */
+    unsigned int stream_id;            /* Generator thread, set by the thread */
+    
+    /* Field modifiers, applied to the template */
+    field_modifier_t modifiers[MAX_MODIFIERS];
+    unsigned int num_modifiers;
+    
+    /* Packet size mix; packet_size is used when empty */
+    size_class_t size_classes[MAX_SIZE_CLASSES];
+    unsigned int num_size_classes;
+    
     /* Statistics */
     unsigned long packets_sent;        /* Number of packets sent */
     unsigned long bytes_sent;          /* Number of bytes sent */
@@ -318,67 +438,500 @@ int build_packet(unsigned char *buffer, traffic_config_t *config) {
     return offset;  /* Total packet size */
 }
 
+/* Names of the modifiable fields, indexed by field_id_t */
+static const char *const field_names[] = {
+    "src-mac", "dst-mac", "src-ip", "dst-ip", "src-port", "dst-port", "vlan"
+};
+
 /**
- * Calculate delay between packets based on pattern
+ * Packet built once, with the offsets of the fields patched per packet
  */
-unsigned long calculate_delay(traffic_config_t *config, unsigned long packet_count) {
-    static double phase = 0.0;
-    unsigned long delay_usec = 0;
+typedef struct {
+    unsigned char frame[MAX_PACKET_SIZE];
+    unsigned int len;
+    unsigned int min_len;              /* Length of the headers; shorter sizes are rounded up */
+    int vlan_offset;                   /* Offset of the VLAN TCI, -1 if none */
+    int ip_offset;                     /* Offset of the IPv4 header, -1 if none */
+    int l4_offset;                     /* Offset of the UDP/TCP header, -1 if none */
+    uint32_t inc_state[MAX_MODIFIERS]; /* Current offset of each incrementing modifier */
+    uint32_t rng;                      /* xorshift32 state of the random modifiers */
+    const traffic_config_t *config;
+} packet_template_t;
+
+/**
+ * Parse a field modifier, <field>:<inc|rand>:<count>
+ */
+int parse_field_modifier(const char *str, field_modifier_t *mod) {
+    char name[16], mode[8];
+    unsigned long count;
+
+    if (sscanf(str, "%15[^:]:%7[^:]:%lu", name, mode, &count) != 3 || count == 0 || count > UINT32_MAX) {
+        return -1;
+    }
+
+    unsigned int i;
+    for (i = 0; i < sizeof(field_names) / sizeof(field_names[0]); i++) {
+        if (strcmp(name, field_names[i]) == 0) {
+            break;
+        }
+    }
+    if (i == sizeof(field_names) / sizeof(field_names[0])) {
+        return -1;
+    }
+    mod->field = (field_id_t)i;
+
+    if (strcmp(mode, "inc") == 0) {
+        mod->mode = MODIFIER_INC;
+    } else if (strcmp(mode, "rand") == 0) {
+        mod->mode = MODIFIER_RANDOM;
+    } else {
+        return -1;
+    }
+
+    mod->count = (uint32_t)count;
+    return 0;
+}
+
+/**
+ * Update a checksum for one 16-bit word changing from old to new (RFC 1624)
+ *
+ * All values are in network byte order.
+ */
+static uint16_t checksum_update16(uint16_t check, uint16_t old, uint16_t new) {
+    uint32_t sum = (uint16_t)~check + (uint16_t)~old + new;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+/**
+ * Build the template of a thread and check its modifiers fit the protocol
+ *
+ * @return 0 on success, -1 if a modifier names a field the packets do not have
+ */
+int template_init(packet_template_t *tpl, const traffic_config_t *config, unsigned int seed) {
+    tpl->config = config;
+    tpl->len = build_packet(tpl->frame, (traffic_config_t *)config);
+    tpl->vlan_offset = config->protocol == PROTO_VLAN ? (int)sizeof(struct ether_header) : -1;
+    tpl->ip_offset = -1;
+    tpl->l4_offset = -1;
+    if (config->protocol == PROTO_IP_UDP || config->protocol == PROTO_IP_TCP) {
+        tpl->ip_offset = sizeof(struct ether_header);
+        tpl->l4_offset = tpl->ip_offset + sizeof(struct iphdr);
+    }
+    switch (config->protocol) {
+        case PROTO_IP_UDP:
+            tpl->min_len = tpl->l4_offset + sizeof(struct udphdr);
+            break;
+        case PROTO_IP_TCP:
+            tpl->min_len = tpl->l4_offset + sizeof(struct tcphdr);
+            break;
+        case PROTO_VLAN:
+            tpl->min_len = tpl->vlan_offset + 4;
+            break;
+        case PROTO_ARP:
+            tpl->min_len = tpl->len;      /* ARP packets have no payload to vary */
+            break;
+        case PROTO_ETH_RAW:
+        default:
+            tpl->min_len = sizeof(struct ether_header);
+            break;
+    }
+    memset(tpl->inc_state, 0, sizeof(tpl->inc_state));
+    tpl->rng = seed ? seed : 1;
+
+    for (unsigned int i = 0; i < config->num_modifiers; i++) {
+        field_id_t field = config->modifiers[i].field;
+        if ((field == FIELD_VLAN && tpl->vlan_offset < 0) ||
+            ((field == FIELD_SRC_IP || field == FIELD_DST_IP) && tpl->ip_offset < 0) ||
+            ((field == FIELD_SRC_PORT || field == FIELD_DST_PORT) && tpl->l4_offset < 0)) {
+            fprintf(stderr, "Field %s is not in the packets of protocol %d\n",
+                    field_names[field], config->protocol);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Value offset of a modifier for the next packet
+ *
+ * Incrementing modifiers count like an odometer, the first one fastest,
+ * so together they go through every combination of their values.
+ */
+static uint32_t template_next_offset(packet_template_t *tpl, unsigned int i, int *carry) {
+    const field_modifier_t *mod = &tpl->config->modifiers[i];
+
+    if (mod->mode == MODIFIER_RANDOM) {
+        uint32_t x = tpl->rng;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        tpl->rng = x;
+        return x % mod->count;
+    }
+
+    uint32_t value = tpl->inc_state[i];
+    if (*carry) {
+        tpl->inc_state[i] = value + 1 < mod->count ? value + 1 : 0;
+        *carry = tpl->inc_state[i] == 0;
+    }
+    return value;
+}
+
+/**
+ * Add n to a MAC address
+ */
+static void mac_add(unsigned char *dst, const struct ether_addr *base, uint32_t n) {
+    uint64_t value = 0;
+    for (int i = 0; i < ETH_ALEN; i++) {
+        value = (value << 8) | base->ether_addr_octet[i];
+    }
+    value += n;
+    for (int i = ETH_ALEN - 1; i >= 0; i--) {
+        dst[i] = (unsigned char)value;
+        value >>= 8;
+    }
+}
+
+/**
+ * Replace a 16-bit field, fixing up the IP and L4 checksums that cover it
+ */
+static void template_set16(packet_template_t *tpl, unsigned char *frame, int offset, uint16_t value,
+                           int in_ip_header, int in_l4_checksum) {
+    uint16_t old;
+    memcpy(&old, frame + offset, sizeof(old));
+    if (old == value) {
+        return;
+    }
+    memcpy(frame + offset, &value, sizeof(value));
+
+    /* The headers follow the 14-byte Ethernet header, so they are accessed unaligned */
+    uint16_t check;
+    if (in_ip_header) {
+        unsigned char *field = frame + tpl->ip_offset + offsetof(struct iphdr, check);
+        memcpy(&check, field, sizeof(check));
+        check = checksum_update16(check, old, value);
+        memcpy(field, &check, sizeof(check));
+    }
+    if (in_l4_checksum) {
+        unsigned char *field = frame + tpl->l4_offset + (tpl->config->protocol == PROTO_IP_TCP ?
+                               offsetof(struct tcphdr, check) : offsetof(struct udphdr, check));
+        memcpy(&check, field, sizeof(check));
+        /* A zero UDP checksum means none was computed and stays so */
+        if (check != 0) {
+            check = checksum_update16(check, old, value);
+            memcpy(field, &check, sizeof(check));
+        }
+    }
+}
+
+/**
+ * Resize a copy of the template, which was built at the largest size
+ *
+ * @return Length of the frame, len or the header length if that is longer
+ */
+unsigned int template_set_length(packet_template_t *tpl, unsigned char *frame, unsigned int len) {
+    if (len < tpl->min_len) {
+        len = tpl->min_len;
+    } else if (len > tpl->len) {
+        len = tpl->len;
+    }
+
+    /* The L4 checksums are left alone: they cover the payload, which changes too */
+    if (tpl->ip_offset >= 0) {
+        template_set16(tpl, frame, tpl->ip_offset + offsetof(struct iphdr, tot_len),
+                       htons((uint16_t)(len - tpl->ip_offset)), 1, 0);
+    }
+    if (tpl->config->protocol == PROTO_IP_UDP) {
+        uint16_t udp_len = htons((uint16_t)(len - tpl->l4_offset));
+        memcpy(frame + tpl->l4_offset + offsetof(struct udphdr, len), &udp_len, sizeof(udp_len));
+    }
+    return len;
+}
+
+/**
+ * Patch a copy of the template for one packet
+ *
+ * Sets the IP ID and TCP sequence number from the packet count and
+ * applies the modifiers, with incremental checksum fixups.
+ */
+void template_apply(packet_template_t *tpl, unsigned char *frame, unsigned long packet_count) {
+    const traffic_config_t *config = tpl->config;
+
+    if (tpl->ip_offset >= 0) {
+        template_set16(tpl, frame, tpl->ip_offset + offsetof(struct iphdr, id),
+                       htons((uint16_t)packet_count), 1, 0);
+    }
+    if (config->protocol == PROTO_IP_TCP) {
+        uint32_t seq = htonl((uint32_t)packet_count);
+        uint16_t half[2];
+        memcpy(half, &seq, sizeof(seq));
+        template_set16(tpl, frame, tpl->l4_offset + offsetof(struct tcphdr, seq), half[0], 0, 1);
+        template_set16(tpl, frame, tpl->l4_offset + offsetof(struct tcphdr, seq) + 2, half[1], 0, 1);
+    }
+
+    int carry = 1;
+    for (unsigned int i = 0; i < config->num_modifiers; i++) {
+        uint32_t n = template_next_offset(tpl, i, &carry);
+
+        switch (config->modifiers[i].field) {
+            case FIELD_SRC_MAC:
+                mac_add(frame + ETH_ALEN, &config->src_mac, n);
+                break;
+
+            case FIELD_DST_MAC:
+                mac_add(frame, &config->dst_mac, n);
+                break;
+
+            case FIELD_SRC_IP:
+            case FIELD_DST_IP: {
+                int src = config->modifiers[i].field == FIELD_SRC_IP;
+                int offset = tpl->ip_offset + (src ? offsetof(struct iphdr, saddr) : offsetof(struct iphdr, daddr));
+                uint32_t base = ntohl(src ? config->src_ip.s_addr : config->dst_ip.s_addr);
+                uint32_t addr = htonl(base + n);
+                uint16_t half[2];
+                memcpy(half, &addr, sizeof(addr));
+                template_set16(tpl, frame, offset, half[0], 1, 1);
+                template_set16(tpl, frame, offset + 2, half[1], 1, 1);
+                break;
+            }
+
+            case FIELD_SRC_PORT:
+                template_set16(tpl, frame, tpl->l4_offset, htons((uint16_t)(config->src_port + n)), 0, 1);
+                break;
+
+            case FIELD_DST_PORT:
+                template_set16(tpl, frame, tpl->l4_offset + 2, htons((uint16_t)(config->dst_port + n)), 0, 1);
+                break;
+
+            case FIELD_VLAN: {
+                /* VLAN IDs stay within 1..4094 */
+                uint16_t vid = 1 + (config->vlan_id + 4093 + n) % 4094;
+                uint16_t tci = htons((config->vlan_priority << 13) | vid);
+                memcpy(frame + tpl->vlan_offset, &tci, sizeof(tci));
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Current monotonic time in nanoseconds
+ */
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Calculate delay between packets based on pattern, in nanoseconds
+ *
+ * The sine wave follows the packet count, so every thread and every run
+ * goes through the same rates.
+ */
+uint64_t calculate_delay_ns(traffic_config_t *config, unsigned long packet_count) {
+    uint64_t delay_ns = 0;
     
     if (config->packets_per_sec == 0) {
-        return 1000000;  /* Default to 1 packet per second */
+        return 1000000000ULL;  /* Default to 1 packet per second */
     }
     
     /* Base delay for constant rate */
-    unsigned long base_delay = 1000000 / config->packets_per_sec;
+    uint64_t base_delay = 1000000000ULL / config->packets_per_sec;
     
     /* Apply pattern-specific modifications */
     switch (config->pattern) {
         case TRAFFIC_CONSTANT:
-            delay_usec = base_delay;
+            delay_ns = base_delay;
             break;
             
         case TRAFFIC_BURST:
             /* Send bursts of 10 packets quickly, then pause */
             if (packet_count % 10 == 0) {
-                delay_usec = base_delay * 10;
+                delay_ns = base_delay * 10;
             } else {
-                delay_usec = base_delay / 10;
+                delay_ns = base_delay / 10;
             }
             break;
             
         case TRAFFIC_RANDOM:
             /* Random delay between 0.5x and 1.5x base delay */
-            delay_usec = base_delay * (0.5 + (rand() % 1000) / 1000.0);
+            delay_ns = base_delay * (0.5 + (rand() % 1000) / 1000.0);
             break;
             
         case TRAFFIC_RAMP_UP:
             /* Start slow, gradually speed up over time */
-            delay_usec = base_delay * (2.0 - (packet_count % 1000) / 1000.0);
-            if (delay_usec < base_delay / 2) delay_usec = base_delay / 2;
+            delay_ns = base_delay * (2.0 - (packet_count % 1000) / 1000.0);
+            if (delay_ns < base_delay / 2) delay_ns = base_delay / 2;
             break;
             
         case TRAFFIC_RAMP_DOWN:
             /* Start fast, gradually slow down over time */
-            delay_usec = base_delay * (0.5 + (packet_count % 1000) / 1000.0);
-            if (delay_usec > base_delay * 2) delay_usec = base_delay * 2;
+            delay_ns = base_delay * (0.5 + (packet_count % 1000) / 1000.0);
+            if (delay_ns > base_delay * 2) delay_ns = base_delay * 2;
             break;
             
         case TRAFFIC_SINE_WAVE:
-            /* Sinusoidal variation */
-            phase += 0.01;
-            if (phase > 2 * 3.14159) phase = 0;
-            delay_usec = base_delay * (1.0 + 0.5 * sin(phase));
+            /* Sinusoidal variation, one period every 628 packets */
+            delay_ns = base_delay * (1.0 + 0.5 * sin((packet_count % 628) * 0.01));
             break;
             
         default:
-            delay_usec = base_delay;
+            delay_ns = base_delay;
             break;
     }
     
+    return delay_ns > 0 ? delay_ns : 1;  /* Ensure at least 1 nanosecond */
+}
+
+/**
+ * Calculate delay between packets based on pattern, in microseconds
+ */
+unsigned long calculate_delay(traffic_config_t *config, unsigned long packet_count) {
+    uint64_t delay_usec = calculate_delay_ns(config, packet_count) / 1000;
     return delay_usec > 0 ? delay_usec : 1;  /* Ensure at least 1 microsecond */
 }
 
+/**
+ * Token bucket of one thread
+ *
+ * Kept as the send time of the next packet: a packet may go once its
+ * time has come, and time left idle is saved up for at most burst
+ * packets sent back to back.
+ */
+typedef struct {
+    uint64_t due;
+    unsigned int burst;
+} pacer_t;
+
+static void pacer_init(pacer_t *pacer, unsigned int burst) {
+    pacer->due = now_ns();
+    pacer->burst = burst > 0 ? burst : 1;
+}
+
+/**
+ * Take the send time of the next packet if it has come
+ *
+ * @param interval Delay from this packet to the next one
+ * @return 1 if the packet may be sent now, 0 if not yet
+ */
+static int pacer_take(pacer_t *pacer, uint64_t now, uint64_t interval) {
+    if (pacer->due > now) {
+        return 0;
+    }
+
+    /* A full bucket: idle time beyond the burst is not saved up */
+    uint64_t credit = (uint64_t)(pacer->burst - 1) * interval;
+    if (now - pacer->due > credit) {
+        pacer->due = now - credit;
+    }
+    pacer->due += interval;
+    return 1;
+}
+
+/**
+ * Wait until the send time of the next packet, or at most max_ns
+ *
+ * Sleeps to an absolute time with clock_nanosleep(), which does not drift
+ * like usleep(), and spins the last PACE_SPIN_NS to wake up on time.
+ */
+static void pacer_wait(const pacer_t *pacer, uint64_t max_ns) {
+    uint64_t now = now_ns();
+    uint64_t until = pacer->due;
+
+    if (until <= now) {
+        return;
+    }
+    if (until - now > max_ns) {
+        until = now + max_ns;
+    }
+    if (until - now > PACE_SPIN_NS) {
+        uint64_t wake = until - PACE_SPIN_NS;
+        struct timespec ts = { .tv_sec = wake / 1000000000ULL, .tv_nsec = wake % 1000000000ULL };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+    while (now_ns() < until && keep_running) {
+        /* Spin, but let other generator threads sharing the CPU run */
+        sched_yield();
+    }
+}
+
+/**
+ * Parse a packet size mix: "imix" or <size>:<weight>[,<size>:<weight>...]
+ *
+ * IMIX is the simple 7:4:1 mix of 64, 594 and 1518-byte frames.
+ */
+int parse_size_mix(const char *str, traffic_config_t *config) {
+    static const size_class_t imix[] = { { 64, 7 }, { 594, 4 }, { 1518, 1 } };
+    unsigned int total = 0;
+
+    config->num_size_classes = 0;
+    if (strcmp(str, "imix") == 0) {
+        memcpy(config->size_classes, imix, sizeof(imix));
+        config->num_size_classes = sizeof(imix) / sizeof(imix[0]);
+        return 0;
+    }
+
+    const char *p = str;
+    while (*p) {
+        unsigned int size, weight;
+        int used;
+        if (config->num_size_classes == MAX_SIZE_CLASSES ||
+            sscanf(p, "%u:%u%n", &size, &weight, &used) != 2 ||
+            size < MIN_PACKET_SIZE || size > MAX_PACKET_SIZE || weight == 0) {
+            return -1;
+        }
+        total += weight;
+        if (total > MAX_SIZE_WEIGHT) {
+            return -1;
+        }
+        config->size_classes[config->num_size_classes].size = size;
+        config->size_classes[config->num_size_classes].weight = weight;
+        config->num_size_classes++;
+
+        p += used;
+        if (*p == ',') {
+            p++;
+        } else if (*p) {
+            return -1;
+        }
+    }
+    return config->num_size_classes > 0 ? 0 : -1;
+}
+
+/**
+ * Lay out a size mix as the cycle of sizes the packets go through
+ *
+ * Every size appears as often as its weight, shuffled with a fixed seed
+ * so each run sends the same sequence.
+ *
+ * @param[out] sizes Cycle, MAX_SIZE_WEIGHT entries
+ * @return Length of the cycle, 0 if the mix is empty
+ */
+static unsigned int size_mix_cycle(const traffic_config_t *config, unsigned int sizes[], unsigned int seed) {
+    unsigned int n = 0;
+
+    for (unsigned int c = 0; c < config->num_size_classes; c++) {
+        for (unsigned int w = 0; w < config->size_classes[c].weight; w++) {
+            sizes[n++] = config->size_classes[c].size;
+        }
+    }
+
+    uint32_t x = seed ? seed : 1;
+    for (unsigned int i = n; i > 1; i--) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        unsigned int j = x % i;
+        unsigned int tmp = sizes[i - 1];
+        sizes[i - 1] = sizes[j];
+        sizes[j] = tmp;
+    }
+    return n;
+}
+
 /**
  * Print usage information
  */
@@ -387,7 +940,10 @@ void print_usage(const char *progname) {
     printf("Options:\n");
     printf("  -i <interface>   : Network interface to use\n");
     printf("  -s <size>        : Packet size in bytes (default: %d)\n", DEFAULT_PACKET_SIZE);
-    printf("  -r <rate>        : Packets per second (default: 10)\n");
+    printf("  -r <rate>        : Packets per second, split across threads (default: 10)\n");
+    printf("  -b <burst>       : Packets a thread may send back to back (default: %d)\n", DEFAULT_BURST);
+    printf("  -z <mix>         : Packet size mix, overrides -s: imix (64:7,594:4,1518:1)\n");
+    printf("                     or <size>:<weight>[,<size>:<weight>...]\n");
     printf("  -p <pattern>     : Traffic pattern:\n");
     printf("                      0 = Constant rate (default)\n");
     printf("                      1 = Burst traffic\n");
@@ -406,8 +962,24 @@ void print_usage(const char *progname) {
     printf("  -D <IP>          : Destination IP address (default: 192.168.1.1)\n");
     printf("  -I <IP>          : Source IP address (default: 192.168.1.2)\n");
     printf("  -t <duration>    : Duration in seconds (0 = infinite, default)\n");
+    printf("  -n, --count <n>  : Stop after n packets, split across threads (0 = no limit, default)\n");
     printf("  -v <vlan_id>     : VLAN ID (default: 1)\n");
     printf("  -T <threads>     : Number of generator threads (default: 1)\n");
+    printf("  -m, --mmap       : Send through a TPACKET_V3 TX ring with prebuilt frames\n");
+    printf("  -Q, --qdisc-bypass : Bypass the interface qdisc (PACKET_QDISC_BYPASS)\n");
+    printf("  -M, --template   : Build headers once and patch them per packet\n");
+    printf("  -L, --latency    : Stamp a sequence number and send time into each payload\n");
+    printf("  -R, --rx <interface> : Receive the probes on interface and measure latency,\n");
+    printf("                     jitter, loss and reordering\n");
+    printf("  --rx-only        : Only receive, for a second instance on the same host\n");
+    printf("  --rx-threads <n> : Receive threads, each with its own RX ring (default: 1, max: %d)\n", MAX_THREADS);
+    printf("  --rx-fanout <hash|cpu> : Spread frames over the receive threads by flow hash\n");
+    printf("                     (default) or by the CPU that received them\n");
+    printf("  --json <file>    : Also write the statistics as JSON (- for stdout)\n");
+    printf("  -F, --field <field>:<inc|rand>:<count>\n");
+    printf("                   : Vary a field over count values from its base (implies -M);\n");
+    printf("                     fields: src-mac, dst-mac, src-ip, dst-ip, src-port, dst-port, vlan.\n");
+    printf("                     Up to %d; incrementing fields go through every combination\n", MAX_MODIFIERS);
     printf("  -h               : Show this help message\n");
     exit(1);
 }
@@ -472,34 +1044,869 @@ void signal_handler(int signum) {
 }
 
 /**
- * Thread function for generating traffic
+ * Latency probe, written at the start of the payload when --latency is on
+ *
+ * 22 bytes, so it fits a minimum-size UDP frame.
  */
-void *traffic_generator_thread(void *arg) {
-    int thread_id = *((int *)arg);
-    traffic_config_t config = global_config;
-    
-    /* Adjust thread-specific values */
-    config.src_port += thread_id;
-    
-    /* Create raw socket */
-    int sock = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
-    if (sock < 0) {
-        perror("socket");
-        return NULL;
+typedef struct {
+    uint32_t magic;                    /* PROBE_MAGIC */
+    uint16_t stream;                   /* Generator thread */
+    uint64_t seq;                      /* Per-stream probe number, from 0 */
+    uint64_t tx_ns;                    /* CLOCK_MONOTONIC send time */
+} __attribute__((packed)) latency_probe_t;
+
+/**
+ * Log-linear histogram of latencies in nanoseconds, as HdrHistogram
+ *
+ * Values below HIST_SUB_BUCKETS are counted exactly; above, every power
+ * of two is split into HIST_HALF buckets, so a recorded value is off by
+ * at most 1/1024 of itself.
+ */
+typedef struct {
+    uint64_t counts[HIST_COUNTS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+} latency_hist_t;
+
+/**
+ * Receive state of one stream
+ */
+typedef struct {
+    int seen;
+    uint64_t first_seq;
+    uint64_t max_seq;
+    uint64_t received;
+    uint64_t reordered;                /* Probes older than one already received */
+    int64_t last_transit;
+    double jitter_ns;                  /* RFC 3550 interarrival jitter */
+} rx_stream_t;
+
+/**
+ * Latency receiver, one per receive thread; totals are merged into another
+ *
+ * With several threads the probes of one stream may be spread over
+ * them, so reordering is only counted among the probes one thread sees.
+ */
+typedef struct {
+    char interface[IFNAMSIZ];
+    rx_stream_t streams[MAX_THREADS];
+    latency_hist_t hist;
+    uint64_t frames;                   /* Frames received, probes or not */
+    uint64_t ring_drops;               /* Frames the kernel dropped for a full ring */
+    unsigned int threads;              /* Receive threads merged into this state */
+    int fanout;                        /* PACKET_FANOUT argument, 0 for none */
+    int ready;                         /* 1 once bound, -1 if the socket failed */
+} rx_state_t;
+
+volatile sig_atomic_t rx_running = 1;
+
+/**
+ * Offset of the payload, where the probe goes; -1 if the protocol has none
+ */
+static int probe_offset(const traffic_config_t *config) {
+    switch (config->protocol) {
+        case PROTO_IP_UDP:
+            return sizeof(struct ether_header) + sizeof(struct iphdr) + sizeof(struct udphdr);
+        case PROTO_IP_TCP:
+            return sizeof(struct ether_header) + sizeof(struct iphdr) + sizeof(struct tcphdr);
+        case PROTO_VLAN:
+            return sizeof(struct ether_header) + 4;
+        case PROTO_ETH_RAW:
+            return sizeof(struct ether_header);
+        case PROTO_ARP:
+        default:
+            return -1;
     }
-    
-    /* Get interface index */
-    struct ifreq if_idx;
-    memset(&if_idx, 0, sizeof(struct ifreq));
-    strncpy(if_idx.ifr_name, config.interface, IFNAMSIZ-1);
-    if (ioctl(sock, SIOCGIFINDEX, &if_idx) < 0) {
-        perror("SIOCGIFINDEX");
-        close(sock);
-        return NULL;
+}
+
+/**
+ * Stamp a probe into a frame just before it is sent
+ *
+ * @return 1 if stamped, 0 if the frame has no room for it
+ */
+static int probe_stamp(unsigned char *frame, unsigned int len, int offset, uint16_t stream, uint64_t seq) {
+    latency_probe_t probe;
+
+    if (offset < 0 || len < offset + sizeof(probe)) {
+        return 0;
     }
-    
-    /* Set up socket address */
-    struct sockaddr_ll socket_address;
+    probe.magic = htonl(PROBE_MAGIC);
+    probe.stream = stream;
+    probe.seq = seq;
+    probe.tx_ns = now_ns();
+    memcpy(frame + offset, &probe, sizeof(probe));
+    return 1;
+}
+
+/**
+ * Find the probe of a received frame
+ *
+ * The payload is looked for behind the IPv4 and UDP/TCP headers when the
+ * frame has them, and right behind the Ethernet header or VLAN tag.
+ */
+static int probe_find(const unsigned char *frame, unsigned int len, latency_probe_t *probe) {
+    unsigned int offsets[3];
+    unsigned int n = 0;
+    unsigned int l3 = sizeof(struct ether_header);
+    uint16_t ethertype;
+
+    memcpy(&ethertype, frame + 12, sizeof(ethertype));
+    if (ethertype == htons(0x8100)) {
+        l3 += 4;
+        memcpy(&ethertype, frame + 16, sizeof(ethertype));
+    }
+    if (ethertype == htons(ETH_P_IP) && len >= l3 + sizeof(struct iphdr)) {
+        unsigned int ihl = (frame[l3] & 0x0f) * 4;
+        uint8_t proto = frame[l3 + 9];
+        if (proto == IPPROTO_UDP) {
+            offsets[n++] = l3 + ihl + sizeof(struct udphdr);
+        } else if (proto == IPPROTO_TCP && len >= l3 + ihl + 13) {
+            offsets[n++] = l3 + ihl + (frame[l3 + ihl + 12] >> 4) * 4;
+        }
+    }
+    offsets[n++] = l3;
+    if (l3 != sizeof(struct ether_header)) {
+        offsets[n++] = sizeof(struct ether_header);
+    }
+
+    for (unsigned int i = 0; i < n; i++) {
+        if (len >= offsets[i] + sizeof(*probe)) {
+            memcpy(probe, frame + offsets[i], sizeof(*probe));
+            if (probe->magic == htonl(PROBE_MAGIC) && probe->stream < MAX_THREADS) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static unsigned int hist_index(uint64_t value) {
+    if (value < HIST_SUB_BUCKETS) {
+        return (unsigned int)value;
+    }
+    unsigned int shift = (63 - __builtin_clzll(value)) - (HIST_SUB_BUCKET_BITS - 1);
+    if (shift > HIST_MAX_SHIFT) {
+        shift = HIST_MAX_SHIFT;
+        value = ((uint64_t)HIST_SUB_BUCKETS << shift) - 1;
+    }
+    return HIST_SUB_BUCKETS + (shift - 1) * HIST_HALF + (unsigned int)((value >> shift) - HIST_HALF);
+}
+
+/**
+ * Highest value counted in a bucket
+ */
+static uint64_t hist_value(unsigned int index) {
+    if (index < HIST_SUB_BUCKETS) {
+        return index;
+    }
+    unsigned int k = index - HIST_SUB_BUCKETS;
+    unsigned int shift = k / HIST_HALF + 1;
+    uint64_t mantissa = k % HIST_HALF + HIST_HALF;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+static void hist_record(latency_hist_t *hist, uint64_t value) {
+    hist->counts[hist_index(value)]++;
+    if (hist->total == 0 || value < hist->min) {
+        hist->min = value;
+    }
+    if (value > hist->max) {
+        hist->max = value;
+    }
+    hist->total++;
+    hist->sum += value;
+}
+
+/**
+ * Value at or below which percentile percent of the recorded values are
+ */
+static uint64_t hist_percentile(const latency_hist_t *hist, double percentile) {
+    if (hist->total == 0) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(percentile / 100.0 * hist->total + 0.5);
+    if (target < 1) {
+        target = 1;
+    }
+    uint64_t count = 0;
+    for (unsigned int i = 0; i < HIST_COUNTS; i++) {
+        count += hist->counts[i];
+        if (count >= target) {
+            uint64_t value = hist_value(i);
+            return value < hist->max ? value : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+/**
+ * Account one received probe
+ */
+static void latency_record(rx_state_t *rx, const latency_probe_t *probe, uint64_t rx_ns) {
+    rx_stream_t *stream = &rx->streams[probe->stream];
+    int64_t transit = (int64_t)(rx_ns - probe->tx_ns);
+
+    /* Clocks of a paired instance may disagree; a negative latency counts as none */
+    hist_record(&rx->hist, transit > 0 ? (uint64_t)transit : 0);
+
+    if (!stream->seen) {
+        stream->seen = 1;
+        stream->first_seq = probe->seq;
+        stream->max_seq = probe->seq;
+    } else {
+        if (probe->seq < stream->max_seq) {
+            stream->reordered++;
+        } else {
+            stream->max_seq = probe->seq;
+        }
+        int64_t d = transit - stream->last_transit;
+        stream->jitter_ns += ((d < 0 ? -d : d) - stream->jitter_ns) / 16.0;
+    }
+    if (probe->seq < stream->first_seq) {
+        stream->first_seq = probe->seq;
+    }
+    stream->last_transit = transit;
+    stream->received++;
+}
+
+/**
+ * Receive ring of one receive thread
+ */
+typedef struct {
+    int sock;
+    unsigned char *map;
+    size_t map_size;
+} rx_ring_t;
+
+static void rx_ring_close(rx_ring_t *ring) {
+    if (ring->map && ring->map != MAP_FAILED) {
+        munmap(ring->map, ring->map_size);
+    }
+    if (ring->sock >= 0) {
+        close(ring->sock);
+    }
+    ring->map = NULL;
+    ring->sock = -1;
+}
+
+/**
+ * Set up a TPACKET_V3 RX ring on the interface and join the fanout group
+ *
+ * @return 0 on success, -1 on error
+ */
+static int rx_ring_open(rx_ring_t *ring, const rx_state_t *rx) {
+    int version = TPACKET_V3;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->sock = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (ring->sock < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    if (setsockopt(ring->sock, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        perror("setsockopt(PACKET_VERSION)");
+        goto fail;
+    }
+
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = RX_RING_BLOCK_SIZE;
+    req.tp_block_nr = RX_RING_BLOCKS;
+    req.tp_frame_size = RX_RING_FRAME_SIZE;
+    req.tp_frame_nr = (RX_RING_BLOCK_SIZE / RX_RING_FRAME_SIZE) * RX_RING_BLOCKS;
+    req.tp_retire_blk_tov = RX_RING_RETIRE_MS;
+    if (setsockopt(ring->sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        perror("setsockopt(PACKET_RX_RING)");
+        goto fail;
+    }
+
+    ring->map_size = (size_t)req.tp_block_size * req.tp_block_nr;
+    ring->map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED,
+                     ring->sock, 0);
+    if (ring->map == MAP_FAILED) {
+        /* Locking may exceed RLIMIT_MEMLOCK; the ring works unlocked too */
+        ring->map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->sock, 0);
+    }
+    if (ring->map == MAP_FAILED) {
+        perror("mmap");
+        goto fail;
+    }
+
+    struct ifreq if_idx;
+    memset(&if_idx, 0, sizeof(struct ifreq));
+    strncpy(if_idx.ifr_name, rx->interface, IFNAMSIZ-1);
+    if (ioctl(ring->sock, SIOCGIFINDEX, &if_idx) < 0) {
+        perror("SIOCGIFINDEX");
+        goto fail;
+    }
+
+    struct sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = if_idx.ifr_ifindex;
+    if (bind(ring->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        goto fail;
+    }
+
+    /* The group is joined once bound; each socket then gets its share of the frames */
+    if (rx->fanout && setsockopt(ring->sock, SOL_PACKET, PACKET_FANOUT, &rx->fanout, sizeof(rx->fanout)) < 0) {
+        perror("setsockopt(PACKET_FANOUT)");
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    rx_ring_close(ring);
+    return -1;
+}
+
+/**
+ * Validate the frames of one ring block
+ *
+ * Frames carry CLOCK_REALTIME kernel timestamps; probes carry
+ * CLOCK_MONOTONIC send times, so the offset between the clocks is taken
+ * once per block.
+ */
+static void rx_ring_block(rx_state_t *rx, struct tpacket_block_desc *block) {
+    struct tpacket3_hdr *hdr = (struct tpacket3_hdr *)((unsigned char *)block + block->hdr.bh1.offset_to_first_pkt);
+    uint32_t count = block->hdr.bh1.num_pkts;
+    struct timespec realtime;
+    uint64_t mono = now_ns();
+
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    int64_t offset = (int64_t)((uint64_t)realtime.tv_sec * 1000000000ULL + (uint64_t)realtime.tv_nsec) -
+                     (int64_t)mono;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const struct sockaddr_ll *from =
+            (const struct sockaddr_ll *)((unsigned char *)hdr + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        const unsigned char *frame = (const unsigned char *)hdr + hdr->tp_mac;
+        latency_probe_t probe;
+
+        /* Frames this host sends on the interface are seen too */
+        if (from->sll_pkttype != PACKET_OUTGOING && hdr->tp_snaplen >= sizeof(struct ether_header)) {
+            rx->frames++;
+            if (probe_find(frame, hdr->tp_snaplen, &probe)) {
+                uint64_t rx_ns = (uint64_t)hdr->tp_sec * 1000000000ULL + hdr->tp_nsec;
+                latency_record(rx, &probe, (uint64_t)((int64_t)rx_ns - offset));
+            }
+        }
+        hdr = (struct tpacket3_hdr *)((unsigned char *)hdr + hdr->tp_next_offset);
+    }
+}
+
+/**
+ * Thread receiving the probes on an interface, a ring block at a time
+ */
+void *latency_receiver_thread(void *arg) {
+    rx_state_t *rx = (rx_state_t *)arg;
+    rx_ring_t ring;
+    unsigned int current = 0;
+
+    if (rx_ring_open(&ring, rx) != 0) {
+        __atomic_store_n(&rx->ready, -1, __ATOMIC_RELEASE);
+        return NULL;
+    }
+    __atomic_store_n(&rx->ready, 1, __ATOMIC_RELEASE);
+
+    while (rx_running) {
+        struct tpacket_block_desc *block =
+            (struct tpacket_block_desc *)(ring.map + (size_t)current * RX_RING_BLOCK_SIZE);
+
+        if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            /* Wake up now and then to notice the end of the run */
+            struct pollfd pfd = { .fd = ring.sock, .events = POLLIN | POLLERR };
+            poll(&pfd, 1, 100);
+            continue;
+        }
+
+        rx_ring_block(rx, block);
+        __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        current = (current + 1) % RX_RING_BLOCKS;
+    }
+
+    struct tpacket_stats_v3 stats;
+    socklen_t len = sizeof(stats);
+    if (getsockopt(ring.sock, SOL_PACKET, PACKET_STATISTICS, &stats, &len) == 0) {
+        rx->ring_drops += stats.tp_drops;
+    }
+
+    rx_ring_close(&ring);
+    return NULL;
+}
+
+/**
+ * Add the counts of one receive thread to the totals
+ */
+static void rx_merge(rx_state_t *total, const rx_state_t *rx) {
+    for (int i = 0; i < MAX_THREADS; i++) {
+        rx_stream_t *dst = &total->streams[i];
+        const rx_stream_t *src = &rx->streams[i];
+
+        if (!src->seen) {
+            continue;
+        }
+        if (!dst->seen) {
+            *dst = *src;
+            continue;
+        }
+        if (src->first_seq < dst->first_seq) {
+            dst->first_seq = src->first_seq;
+        }
+        if (src->max_seq > dst->max_seq) {
+            dst->max_seq = src->max_seq;
+        }
+        dst->jitter_ns = (dst->jitter_ns * dst->received + src->jitter_ns * src->received) /
+                         (dst->received + src->received);
+        dst->received += src->received;
+        dst->reordered += src->reordered;
+    }
+
+    for (unsigned int i = 0; i < HIST_COUNTS; i++) {
+        total->hist.counts[i] += rx->hist.counts[i];
+    }
+    if (rx->hist.total > 0) {
+        if (total->hist.total == 0 || rx->hist.min < total->hist.min) {
+            total->hist.min = rx->hist.min;
+        }
+        if (rx->hist.max > total->hist.max) {
+            total->hist.max = rx->hist.max;
+        }
+    }
+    total->hist.total += rx->hist.total;
+    total->hist.sum += rx->hist.sum;
+    total->frames += rx->frames;
+    total->ring_drops += rx->ring_drops;
+    total->threads++;
+}
+
+/**
+ * Totals of the streams of a receiver
+ */
+static void latency_totals(const rx_state_t *rx, uint64_t *received, uint64_t *lost,
+                           uint64_t *reordered, double *jitter_ns) {
+    double jitter_sum = 0;
+
+    *received = *lost = *reordered = 0;
+    for (int i = 0; i < MAX_THREADS; i++) {
+        const rx_stream_t *stream = &rx->streams[i];
+        if (!stream->seen) {
+            continue;
+        }
+        uint64_t expected = stream->max_seq - stream->first_seq + 1;
+        *received += stream->received;
+        *lost += expected > stream->received ? expected - stream->received : 0;
+        *reordered += stream->reordered;
+        jitter_sum += stream->jitter_ns * stream->received;
+    }
+    *jitter_ns = *received ? jitter_sum / *received : 0;
+}
+
+/**
+ * Print latency statistics
+ */
+void print_latency_statistics(const rx_state_t *rx) {
+    uint64_t received, lost, reordered;
+    double jitter_ns;
+    const latency_hist_t *hist = &rx->hist;
+
+    latency_totals(rx, &received, &lost, &reordered, &jitter_ns);
+    printf("\nLatency (%s):\n", rx->interface);
+    printf("  Probes received: %lu of %lu frames on %u thread%s, ring drops: %lu\n", (unsigned long)received,
+           (unsigned long)rx->frames, rx->threads, rx->threads == 1 ? "" : "s", (unsigned long)rx->ring_drops);
+    printf("  Lost: %lu (%.4f%%)  Reordered: %lu\n", (unsigned long)lost,
+           received + lost ? 100.0 * lost / (received + lost) : 0.0, (unsigned long)reordered);
+    if (hist->total == 0) {
+        return;
+    }
+    printf("  Latency us: min %.3f  mean %.3f  p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n",
+           hist->min / 1000.0, hist->sum / hist->total / 1000.0,
+           hist_percentile(hist, 50.0) / 1000.0, hist_percentile(hist, 90.0) / 1000.0,
+           hist_percentile(hist, 99.0) / 1000.0, hist_percentile(hist, 99.9) / 1000.0,
+           hist->max / 1000.0);
+    printf("  Jitter us: %.3f\n", jitter_ns / 1000.0);
+}
+
+/**
+ * Write the statistics as JSON, to a file or "-" for standard output
+ *
+ * @return 0 on success, -1 if the file cannot be written
+ */
+int write_json_statistics(const char *path, const traffic_config_t *config, const rx_state_t *rx) {
+    FILE *out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(out, "{\n  \"sent\": { \"packets\": %lu, \"bytes\": %lu }", config->packets_sent, config->bytes_sent);
+    if (rx) {
+        uint64_t received, lost, reordered;
+        double jitter_ns;
+        const latency_hist_t *hist = &rx->hist;
+
+        latency_totals(rx, &received, &lost, &reordered, &jitter_ns);
+        fprintf(out, ",\n  \"received\": { \"interface\": \"%s\", \"threads\": %u, \"frames\": %lu, "
+                     "\"ring_drops\": %lu, \"probes\": %lu, \"lost\": %lu, \"reordered\": %lu },\n",
+                rx->interface, rx->threads, (unsigned long)rx->frames, (unsigned long)rx->ring_drops,
+                (unsigned long)received, (unsigned long)lost, (unsigned long)reordered);
+        fprintf(out, "  \"latency_ns\": { \"count\": %lu, \"min\": %lu, \"mean\": %.1f, \"p50\": %lu, "
+                     "\"p90\": %lu, \"p99\": %lu, \"p99_9\": %lu, \"max\": %lu },\n",
+                (unsigned long)hist->total, (unsigned long)hist->min,
+                hist->total ? hist->sum / hist->total : 0.0,
+                (unsigned long)hist_percentile(hist, 50.0), (unsigned long)hist_percentile(hist, 90.0),
+                (unsigned long)hist_percentile(hist, 99.0), (unsigned long)hist_percentile(hist, 99.9),
+                (unsigned long)hist->max);
+        fprintf(out, "  \"jitter_ns\": %.1f", jitter_ns);
+    }
+    fprintf(out, "\n}\n");
+
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
+
+/**
+ * TPACKET_V3 TX ring of one generator thread
+ */
+typedef struct {
+    int sock;
+    unsigned char *map;
+    size_t map_size;
+    unsigned int block_size;
+    unsigned int frame_size;
+    unsigned int frames_per_block;
+    unsigned int frame_nr;
+    unsigned int head;                 /* Next frame to fill */
+    unsigned int frame_len;            /* Length of the prebuilt frame */
+} tx_ring_t;
+
+/**
+ * Frame header of ring slot i; frames never straddle blocks
+ */
+static struct tpacket3_hdr *tx_ring_slot(tx_ring_t *ring, unsigned int i) {
+    return (struct tpacket3_hdr *)(ring->map + (size_t)(i / ring->frames_per_block) * ring->block_size +
+                                   (size_t)(i % ring->frames_per_block) * ring->frame_size);
+}
+
+/**
+ * Frame data of a ring slot, where the kernel expects it without PACKET_TX_HAS_OFF
+ */
+static unsigned char *tx_ring_data(struct tpacket3_hdr *hdr) {
+    return (unsigned char *)hdr + TPACKET3_HDRLEN - sizeof(struct sockaddr_ll);
+}
+
+/**
+ * Close a TX ring
+ */
+static void tx_ring_close(tx_ring_t *ring) {
+    if (ring->map && ring->map != MAP_FAILED) {
+        munmap(ring->map, ring->map_size);
+    }
+    if (ring->sock >= 0) {
+        close(ring->sock);
+    }
+    ring->map = NULL;
+    ring->sock = -1;
+}
+
+/**
+ * Set up a TX ring on the interface with every frame prebuilt
+ *
+ * @return 0 on success, -1 on error
+ */
+static int tx_ring_open(tx_ring_t *ring, traffic_config_t *config, const packet_template_t *tpl) {
+    int version = TPACKET_V3;
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    memset(ring, 0, sizeof(*ring));
+    ring->sock = -1;
+
+    /* Protocol 0: the socket only sends, so nothing is queued to it on receive */
+    ring->sock = socket(AF_PACKET, SOCK_RAW, 0);
+    if (ring->sock < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    if (setsockopt(ring->sock, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        perror("setsockopt(PACKET_VERSION)");
+        goto fail;
+    }
+
+    if (config->qdisc_bypass) {
+        int one = 1;
+        if (setsockopt(ring->sock, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one)) < 0) {
+            perror("setsockopt(PACKET_QDISC_BYPASS)");
+            goto fail;
+        }
+    }
+
+    /* Fixed-size frames; a block holds a whole number of them */
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    ring->frame_size = TPACKET_ALIGN(TPACKET3_HDRLEN + MAX_PACKET_SIZE);
+    req.tp_frame_size = ring->frame_size;
+    req.tp_block_size = ((ring->frame_size * 16 + page_size - 1) / page_size) * page_size;
+    ring->frames_per_block = req.tp_block_size / req.tp_frame_size;
+    req.tp_block_nr = (TX_RING_FRAMES + ring->frames_per_block - 1) / ring->frames_per_block;
+    req.tp_frame_nr = req.tp_block_nr * ring->frames_per_block;
+    if (setsockopt(ring->sock, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+        perror("setsockopt(PACKET_TX_RING)");
+        goto fail;
+    }
+    ring->block_size = req.tp_block_size;
+    ring->frame_nr = req.tp_frame_nr;
+
+    ring->map_size = (size_t)req.tp_block_size * req.tp_block_nr;
+    ring->map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->sock, 0);
+    if (ring->map == MAP_FAILED) {
+        perror("mmap");
+        goto fail;
+    }
+
+    /* Bound, so a kick needs no address */
+    struct ifreq if_idx;
+    memset(&if_idx, 0, sizeof(struct ifreq));
+    strncpy(if_idx.ifr_name, config->interface, IFNAMSIZ-1);
+    if (ioctl(ring->sock, SIOCGIFINDEX, &if_idx) < 0) {
+        perror("SIOCGIFINDEX");
+        goto fail;
+    }
+
+    struct sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = 0;
+    addr.sll_ifindex = if_idx.ifr_ifindex;
+    if (bind(ring->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        goto fail;
+    }
+
+    /* Every frame starts as a copy of the template */
+    ring->frame_len = tpl->len;
+    for (unsigned int i = 0; i < ring->frame_nr; i++) {
+        struct tpacket3_hdr *hdr = tx_ring_slot(ring, i);
+        memcpy(tx_ring_data(hdr), tpl->frame, ring->frame_len);
+        hdr->tp_len = ring->frame_len;
+        hdr->tp_snaplen = ring->frame_len;
+        hdr->tp_next_offset = 0;
+        hdr->tp_status = TP_STATUS_AVAILABLE;
+    }
+
+    return 0;
+
+fail:
+    tx_ring_close(ring);
+    return -1;
+}
+
+/**
+ * Generate traffic through a TX ring
+ *
+ * Frames are queued as the pacer lets them, up to TX_RING_BATCH at a
+ * time, and the kernel is kicked once per batch.
+ *
+ * @param sizes Cycle of packet sizes, NULL to send the template as built
+ * @param num_sizes Length of the cycle
+ */
+static void tx_ring_generate(traffic_config_t *config, packet_template_t *tpl,
+                             const unsigned int *sizes, unsigned int num_sizes) {
+    tx_ring_t ring;
+    if (tx_ring_open(&ring, config, tpl) != 0) {
+        return;
+    }
+
+    unsigned long packet_count = 0;
+    unsigned long local_packets_sent = 0;
+    unsigned long local_bytes_sent = 0;
+    unsigned long send_errors = 0;
+    uint64_t probe_seq = 0;
+    int probe_off = config->latency ? probe_offset(config) : -1;
+    uint64_t start = now_ns();
+    uint64_t interval = calculate_delay_ns(config, 0);
+    pacer_t pacer;
+    pacer_init(&pacer, config->burst);
+
+    while (keep_running) {
+        uint64_t now = now_ns();
+
+        if (config->duration > 0 && now - start >= (uint64_t)config->duration * 1000000000ULL) {
+            break;
+        }
+        if (config->count > 0 && packet_count >= config->count) {
+            break;
+        }
+
+        unsigned int queued = 0;
+        unsigned long queued_bytes = 0;
+        int ring_full = 0;
+        while (queued < TX_RING_BATCH && pacer.due <= now &&
+               (config->count == 0 || packet_count < config->count)) {
+            struct tpacket3_hdr *hdr = tx_ring_slot(&ring, ring.head);
+            uint32_t status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+
+            if (status == TP_STATUS_WRONG_FORMAT) {
+                /* The kernel refused the frame; it goes back to the pool */
+                send_errors++;
+            } else if (status != TP_STATUS_AVAILABLE) {
+                ring_full = 1;
+                break;
+            }
+
+            if (!pacer_take(&pacer, now, interval)) {
+                break;
+            }
+
+            unsigned char *frame = tx_ring_data(hdr);
+            unsigned int len = ring.frame_len;
+            if (sizes) {
+                len = template_set_length(tpl, frame, sizes[packet_count % num_sizes]);
+            }
+            template_apply(tpl, frame, packet_count);
+            probe_seq += probe_stamp(frame, len, probe_off, config->stream_id, probe_seq);
+            hdr->tp_len = len;
+            __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+            ring.head = (ring.head + 1) % ring.frame_nr;
+            packet_count++;
+            interval = calculate_delay_ns(config, packet_count);
+            queued++;
+            queued_bytes += len;
+        }
+
+        if (queued > 0) {
+            if (sendto(ring.sock, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+                errno != EAGAIN && errno != ENOBUFS) {
+                perror("sendto");
+                send_errors++;
+            }
+            local_packets_sent += queued;
+            local_bytes_sent += queued_bytes;
+        }
+
+        if (ring_full) {
+            /* Wait for the kernel to hand frames back */
+            struct pollfd pfd = { .fd = ring.sock, .events = POLLOUT };
+            poll(&pfd, 1, 10);
+        } else {
+            /* Short enough to notice the end of the run */
+            pacer_wait(&pacer, 100000000ULL);
+        }
+    }
+
+    /* Let the queued frames leave before the ring goes away */
+    sendto(ring.sock, NULL, 0, 0, NULL, 0);
+
+    pthread_mutex_lock(&stats_mutex);
+    global_config.packets_sent += local_packets_sent;
+    global_config.bytes_sent += local_bytes_sent;
+    pthread_mutex_unlock(&stats_mutex);
+
+    if (send_errors > 0) {
+        fprintf(stderr, "TX ring: %lu frames not sent\n", send_errors);
+    }
+
+    tx_ring_close(&ring);
+}
+
+/**
+ * Thread function for generating traffic
+ */
+void *traffic_generator_thread(void *arg) {
+    int thread_id = *((int *)arg);
+    traffic_config_t config = global_config;
+    
+    /* Adjust thread-specific values */
+    config.src_port += thread_id;
+    config.stream_id = thread_id;
+    
+    /* Each thread sends its share of the total rate */
+    unsigned long share = global_config.packets_per_sec / config.num_threads;
+    if ((unsigned long)thread_id < global_config.packets_per_sec % config.num_threads) {
+        share++;
+    }
+    if (share == 0 && global_config.packets_per_sec > 0) {
+        return NULL;
+    }
+    config.packets_per_sec = share;
+    
+    /* And its share of the packet count */
+    if (global_config.count > 0) {
+        config.count = global_config.count / config.num_threads;
+        if ((unsigned long)thread_id < global_config.count % config.num_threads) {
+            config.count++;
+        }
+        if (config.count == 0) {
+            return NULL;
+        }
+    }
+    
+    /* A size mix goes through a fixed cycle of sizes; packets are built at the largest */
+    unsigned int sizes[MAX_SIZE_WEIGHT];
+    unsigned int num_sizes = size_mix_cycle(&config, sizes, 1 + thread_id);
+    for (unsigned int i = 0; i < config.num_size_classes; i++) {
+        if (i == 0 || config.size_classes[i].size > config.packet_size) {
+            config.packet_size = config.size_classes[i].size;
+        }
+    }
+    
+    /* Template modes build the packet once per thread */
+    packet_template_t *tpl = NULL;
+    if (config.use_mmap || config.use_template) {
+        tpl = malloc(sizeof(*tpl));
+        if (!tpl) {
+            perror("malloc");
+            return NULL;
+        }
+        if (template_init(tpl, &config, (unsigned int)time(NULL) ^ ((unsigned int)thread_id << 16)) != 0) {
+            free(tpl);
+            return NULL;
+        }
+    }
+    
+    if (config.use_mmap) {
+        tx_ring_generate(&config, tpl, num_sizes ? sizes : NULL, num_sizes);
+        free(tpl);
+        return NULL;
+    }
+    
+    /* Create raw socket */
+    int sock = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (sock < 0) {
+        perror("socket");
+        free(tpl);
+        return NULL;
+    }
+    
+    /* Get interface index */
+    struct ifreq if_idx;
+    memset(&if_idx, 0, sizeof(struct ifreq));
+    strncpy(if_idx.ifr_name, config.interface, IFNAMSIZ-1);
+    if (ioctl(sock, SIOCGIFINDEX, &if_idx) < 0) {
+        perror("SIOCGIFINDEX");
+        close(sock);
+        free(tpl);
+        return NULL;
+    }
+    
+    if (config.qdisc_bypass) {
+        int one = 1;
+        if (setsockopt(sock, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one)) < 0) {
+            perror("setsockopt(PACKET_QDISC_BYPASS)");
+        }
+    }
+    
+    /* Set up socket address */
+    struct sockaddr_ll socket_address;
     memset(&socket_address, 0, sizeof(struct sockaddr_ll));
     socket_address.sll_family = AF_PACKET;
     socket_address.sll_ifindex = if_idx.ifr_ifindex;
@@ -511,31 +1918,57 @@ void *traffic_generator_thread(void *arg) {
     if (!packet_buffer) {
         perror("malloc");
         close(sock);
+        free(tpl);
         return NULL;
     }
     
     /* Generate traffic */
     unsigned long packet_count = 0;
-    struct timeval start_time, current_time;
-    gettimeofday(&start_time, NULL);
+    uint64_t start_time = now_ns();
+    uint64_t interval = calculate_delay_ns(&config, 0);
     unsigned long local_packets_sent = 0;
     unsigned long local_bytes_sent = 0;
+    pacer_t pacer;
+    pacer_init(&pacer, config.burst);
+    uint64_t probe_seq = 0;
+    int probe_off = config.latency ? probe_offset(&config) : -1;
     
     while (keep_running) {
         /* Check duration if set */
-        if (config.duration > 0) {
-            gettimeofday(&current_time, NULL);
-            unsigned long elapsed = (current_time.tv_sec - start_time.tv_sec);
-            if (elapsed >= config.duration) {
-                break;
-            }
+        uint64_t now = now_ns();
+        if (config.duration > 0 && now - start_time >= (uint64_t)config.duration * 1000000000ULL) {
+            break;
+        }
+        if (config.count > 0 && packet_count >= config.count) {
+            break;
+        }
+        
+        /* Wait for the pacer to let the next packet go */
+        if (!pacer_take(&pacer, now, interval)) {
+            pacer_wait(&pacer, 100000000ULL);
+            continue;
         }
         
-        /* Build the packet */
-        int packet_size = build_packet(packet_buffer, &config);
+        /* Build the packet, or patch the template in place */
+        unsigned char *frame = packet_buffer;
+        int packet_size;
+        if (tpl) {
+            packet_size = tpl->len;
+            if (num_sizes) {
+                packet_size = template_set_length(tpl, tpl->frame, sizes[packet_count % num_sizes]);
+            }
+            template_apply(tpl, tpl->frame, packet_count);
+            frame = tpl->frame;
+        } else {
+            if (num_sizes) {
+                config.packet_size = sizes[packet_count % num_sizes];
+            }
+            packet_size = build_packet(packet_buffer, &config);
+        }
+        probe_seq += probe_stamp(frame, packet_size, probe_off, config.stream_id, probe_seq);
         
         /* Send the packet */
-        int bytes_sent = sendto(sock, packet_buffer, packet_size, 0,
+        int bytes_sent = sendto(sock, frame, packet_size, 0,
                               (struct sockaddr*)&socket_address, sizeof(struct sockaddr_ll));
         
         if (bytes_sent < 0) {
@@ -548,8 +1981,8 @@ void *traffic_generator_thread(void *arg) {
             /* Update global stats periodically */
             if (local_packets_sent % 1000 == 0) {
                 pthread_mutex_lock(&stats_mutex);
-                config.packets_sent += local_packets_sent;
-                config.bytes_sent += local_bytes_sent;
+                global_config.packets_sent += local_packets_sent;
+                global_config.bytes_sent += local_bytes_sent;
                 pthread_mutex_unlock(&stats_mutex);
                 
                 local_packets_sent = 0;
@@ -558,20 +1991,19 @@ void *traffic_generator_thread(void *arg) {
         }
         
         /* Calculate delay for next packet */
-        unsigned long delay_usec = calculate_delay(&config, packet_count);
-        usleep(delay_usec);
-        
         packet_count++;
+        interval = calculate_delay_ns(&config, packet_count);
     }
     
     /* Update final stats */
     pthread_mutex_lock(&stats_mutex);
-    config.packets_sent += local_packets_sent;
-    config.bytes_sent += local_bytes_sent;
+    global_config.packets_sent += local_packets_sent;
+    global_config.bytes_sent += local_bytes_sent;
     pthread_mutex_unlock(&stats_mutex);
     
     /* Clean up */
     free(packet_buffer);
+    free(tpl);
     close(sock);
     
     return NULL;
@@ -601,12 +2033,18 @@ int main(int argc, char *argv[]) {
     int opt;
     traffic_config_t config;
     int i;
+    char rx_interface[IFNAMSIZ] = "";
+    int rx_only = 0;
+    const char *json_path = NULL;
+    unsigned int rx_threads = 1;
+    int rx_fanout_type = PACKET_FANOUT_HASH;
     
     /* Set default values */
     memset(&config, 0, sizeof(traffic_config_t));
     strcpy(config.interface, "eth0");
     config.packet_size = DEFAULT_PACKET_SIZE;
     config.packets_per_sec = 10;
+    config.burst = DEFAULT_BURST;
     config.pattern = TRAFFIC_CONSTANT;
     config.protocol = PROTO_ETH_RAW;
     config.duration = 0;
@@ -624,7 +2062,22 @@ int main(int argc, char *argv[]) {
     inet_pton(AF_INET, "192.168.1.2", &config.src_ip);
     
     /* Parse command line options */
-    while ((opt = getopt(argc, argv, "i:s:r:p:P:d:S:D:I:t:v:T:h")) != -1) {
+    static const struct option long_options[] = {
+        { "mmap",         no_argument, NULL, 'm' },
+        { "qdisc-bypass", no_argument, NULL, 'Q' },
+        { "template",     no_argument, NULL, 'M' },
+        { "field",        required_argument, NULL, 'F' },
+        { "latency",      no_argument, NULL, 'L' },
+        { "rx",           required_argument, NULL, 'R' },
+        { "rx-only",      no_argument, NULL, OPT_RX_ONLY },
+        { "rx-threads",   required_argument, NULL, OPT_RX_THREADS },
+        { "rx-fanout",    required_argument, NULL, OPT_RX_FANOUT },
+        { "json",         required_argument, NULL, OPT_JSON },
+        { "count",        required_argument, NULL, 'n' },
+        { "help",         no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    while ((opt = getopt_long(argc, argv, "i:s:r:b:z:p:P:d:S:D:I:t:n:v:T:mQMF:LR:h", long_options, NULL)) != -1) {
         switch (opt) {
             case 'i':
                 strncpy(config.interface, optarg, IFNAMSIZ-1);
@@ -646,6 +2099,20 @@ int main(int argc, char *argv[]) {
                 config.packets_per_sec = atoi(optarg);
                 break;
                 
+            case 'b':
+                config.burst = atoi(optarg);
+                if (config.burst < 1) {
+                    config.burst = 1;
+                }
+                break;
+                
+            case 'z':
+                if (parse_size_mix(optarg, &config) != 0) {
+                    fprintf(stderr, "Invalid packet size mix: %s\n", optarg);
+                    print_usage(argv[0]);
+                }
+                break;
+                
             case 'p':
                 config.pattern = atoi(optarg);
                 if (config.pattern > TRAFFIC_SINE_WAVE) {
@@ -694,6 +2161,10 @@ int main(int argc, char *argv[]) {
                 config.duration = atoi(optarg);
                 break;
                 
+            case 'n':
+                config.count = strtoul(optarg, NULL, 10);
+                break;
+                
             case 'v':
                 config.vlan_id = atoi(optarg);
                 if (config.vlan_id > 4095) {
@@ -712,6 +2183,69 @@ int main(int argc, char *argv[]) {
                 }
                 break;
                 
+            case 'm':
+                config.use_mmap = 1;
+                break;
+                
+            case 'Q':
+                config.qdisc_bypass = 1;
+                break;
+                
+            case 'M':
+                config.use_template = 1;
+                break;
+                
+            case 'F':
+                if (config.num_modifiers == MAX_MODIFIERS) {
+                    fprintf(stderr, "Too many field modifiers (max %d)\n", MAX_MODIFIERS);
+                    print_usage(argv[0]);
+                }
+                if (parse_field_modifier(optarg, &config.modifiers[config.num_modifiers]) != 0) {
+                    fprintf(stderr, "Invalid field modifier: %s\n", optarg);
+                    print_usage(argv[0]);
+                }
+                config.num_modifiers++;
+                config.use_template = 1;
+                break;
+                
+            case 'L':
+                config.latency = 1;
+                break;
+                
+            case 'R':
+                strncpy(rx_interface, optarg, IFNAMSIZ-1);
+                rx_interface[IFNAMSIZ-1] = '\0';
+                break;
+                
+            case OPT_RX_ONLY:
+                rx_only = 1;
+                break;
+                
+            case OPT_JSON:
+                json_path = optarg;
+                break;
+                
+            case OPT_RX_THREADS:
+                rx_threads = atoi(optarg);
+                if (rx_threads < 1) {
+                    rx_threads = 1;
+                } else if (rx_threads > MAX_THREADS) {
+                    rx_threads = MAX_THREADS;
+                    fprintf(stderr, "Warning: Receive threads reduced to maximum (%d)\n", MAX_THREADS);
+                }
+                break;
+                
+            case OPT_RX_FANOUT:
+                if (strcmp(optarg, "hash") == 0) {
+                    rx_fanout_type = PACKET_FANOUT_HASH;
+                } else if (strcmp(optarg, "cpu") == 0) {
+                    rx_fanout_type = PACKET_FANOUT_CPU;
+                } else {
+                    fprintf(stderr, "Invalid fanout mode: %s\n", optarg);
+                    print_usage(argv[0]);
+                }
+                break;
+                
             case 'h':
             default:
                 print_usage(argv[0]);
@@ -720,7 +2254,7 @@ int main(int argc, char *argv[]) {
     }
 
     /* Get the MAC address of the interface if not specified */
-    if (memcmp(&config.src_mac, "\0\0\0\0\0\0", ETH_ALEN) == 0) {
+    if (!rx_only && memcmp(&config.src_mac, "\0\0\0\0\0\0", ETH_ALEN) == 0) {
         if (get_interface_mac(config.interface, &config.src_mac) != 0) {
             fprintf(stderr, "Error getting MAC address of interface %s\n", config.interface);
             return EXIT_FAILURE;
@@ -738,7 +2272,22 @@ int main(int argc, char *argv[]) {
     printf("Protocol: %d, Pattern: %d, Rate: %lu pps, Size: %u bytes\n", 
            config.protocol, config.pattern, config.packets_per_sec, config.packet_size);
     printf("Duration: %u seconds (0 = infinite)\n", config.duration);
-    printf("Number of threads: %u\n", config.num_threads);
+    printf("Number of threads: %u, burst: %u\n", config.num_threads, config.burst);
+    if (config.num_size_classes > 0) {
+        printf("Size mix:");
+        for (i = 0; i < (int)config.num_size_classes; i++) {
+            printf(" %u:%u", config.size_classes[i].size, config.size_classes[i].weight);
+        }
+        printf("\n");
+    }
+    printf("Transmit: %s%s%s\n", config.use_mmap ? "TX ring" : "sendto",
+           config.use_template || config.use_mmap ? ", template" : "",
+           config.qdisc_bypass ? ", qdisc bypass" : "");
+    for (i = 0; i < (int)config.num_modifiers; i++) {
+        printf("Field %s: %s over %u values\n", field_names[config.modifiers[i].field],
+               config.modifiers[i].mode == MODIFIER_INC ? "incrementing" : "random",
+               config.modifiers[i].count);
+    }
     
     /* Print MAC and IP addresses */
     char src_mac_str[18], dst_mac_str[18];
@@ -768,6 +2317,60 @@ int main(int argc, char *argv[]) {
         printf("VLAN ID: %u  Priority: %u\n", config.vlan_id, config.vlan_priority);
     }
     
+    if (rx_only && rx_interface[0] == '\0') {
+        fprintf(stderr, "--rx-only needs --rx <interface>\n");
+        return EXIT_FAILURE;
+    }
+    if (config.latency && probe_offset(&config) < 0) {
+        fprintf(stderr, "Latency probes need a payload; protocol %d has none\n", config.protocol);
+        return EXIT_FAILURE;
+    }
+    
+    /* The receivers start first, so they see the first probes */
+    rx_state_t *rx = NULL;
+    pthread_t rx_thread_ids[MAX_THREADS];
+    if (rx_interface[0] != '\0') {
+        /* Index 0 holds the totals, the threads use 1 to rx_threads */
+        rx = calloc(rx_threads + 1, sizeof(*rx));
+        if (!rx) {
+            fprintf(stderr, "Error allocating memory for the receiver\n");
+            return EXIT_FAILURE;
+        }
+        memcpy(rx[0].interface, rx_interface, IFNAMSIZ);
+        /* The group ID only has to be unique on the host */
+        int fanout = rx_threads > 1 ? (int)(getpid() & 0xffff) | (rx_fanout_type << 16) : 0;
+        if (rx_fanout_type == PACKET_FANOUT_HASH && fanout) {
+            fanout |= PACKET_FANOUT_FLAG_DEFRAG << 16;
+        }
+        for (unsigned int t = 1; t <= rx_threads; t++) {
+            memcpy(rx[t].interface, rx_interface, IFNAMSIZ);
+            rx[t].fanout = fanout;
+            if (pthread_create(&rx_thread_ids[t - 1], NULL, latency_receiver_thread, &rx[t]) != 0) {
+                fprintf(stderr, "Error creating receiver thread\n");
+                return EXIT_FAILURE;
+            }
+            /* A probe sent before the socket is bound would count as lost */
+            int ready;
+            while ((ready = __atomic_load_n(&rx[t].ready, __ATOMIC_ACQUIRE)) == 0) {
+                usleep(1000);
+            }
+            if (ready < 0) {
+                rx_running = 0;
+                for (unsigned int j = 1; j <= t; j++) {
+                    pthread_join(rx_thread_ids[j - 1], NULL);
+                }
+                free(rx);
+                return EXIT_FAILURE;
+            }
+        }
+        printf("Receiving latency probes on %s with %u thread%s%s\n", rx_interface, rx_threads,
+               rx_threads == 1 ? "" : "s",
+               rx_threads == 1 ? "" : rx_fanout_type == PACKET_FANOUT_CPU ? ", fanout by CPU" : ", fanout by flow hash");
+    }
+    if (rx_only) {
+        config.num_threads = 0;
+    }
+    
     /* Create traffic generator threads */
     pthread_t threads[MAX_THREADS];
     for (i = 0; i < config.num_threads; i++) {
@@ -796,6 +2399,8 @@ int main(int argc, char *argv[]) {
         sleep(config.duration);
         printf("Duration complete, stopping traffic...\n");
         keep_running = 0;
+    } else if (config.count > 0) {
+        printf("Sending %lu packets...\n", config.count);
     } else {
         printf("Running indefinitely. Press Ctrl+C to stop.\n");
     }
@@ -805,8 +2410,31 @@ int main(int argc, char *argv[]) {
         pthread_join(threads[i], NULL);
     }
     
+    /* A receiver waits for the probes still in flight, or for the end of the run */
+    if (rx) {
+        if (rx_only) {
+            while (keep_running) {
+                usleep(100000);
+            }
+        } else {
+            usleep(RX_DRAIN_MS * 1000);
+        }
+        rx_running = 0;
+        for (unsigned int t = 1; t <= rx_threads; t++) {
+            pthread_join(rx_thread_ids[t - 1], NULL);
+            rx_merge(&rx[0], &rx[t]);
+        }
+    }
+    
     /* Print final statistics */
     print_statistics(&global_config);
+    if (rx) {
+        print_latency_statistics(rx);
+    }
+    if (json_path) {
+        write_json_statistics(json_path, &global_config, rx);
+    }
+    free(rx);
     
     printf("Traffic generator stopped.\n");
     return EXIT_SUCCESS;